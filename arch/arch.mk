@@ -20,12 +20,13 @@ LIBARCH_SOURCES := \
 	rt.cc \
 	abort.cc \
 	spinlock.cc \
+	profile_scope.cc \
 	dlopen_mutex.cc \
         file_functions.cc \
 
 
 ifeq ($(ARCH),x86_64)
-LIBARCH_SOURCES += simd_vector_avx.cc
+LIBARCH_SOURCES += simd_vector_avx.cc simd_vector_avx2.cc simd_vector_avx512.cc
 endif
 
 LIBARCH_LINK := \
@@ -50,6 +51,8 @@ $(eval $(call library,gc,$(LIBGC_SOURCES),$(LIBGC_LINK)))
 # Note: we should be able to get away without this, but we get a segfault on
 # shared library loading if it's not here.
 $(eval $(call set_single_compile_option,simd_vector_avx.cc,-mavx))
+$(eval $(call set_single_compile_option,simd_vector_avx2.cc,-mavx2 -mfma -mf16c))
+$(eval $(call set_single_compile_option,simd_vector_avx512.cc,-mavx512f))
 
 $(eval $(call library,exception_hook,exception_hook.cc,arch dl))
 
@@ -7,7 +7,11 @@
 */
 
 #include "cpu_info.h"
+#include "mldb/arch/exception.h"
 
+#include <sched.h>
+#include <dirent.h>
+#include <stdlib.h>
 #include <fstream>
 #include <iostream>
 
@@ -46,5 +50,130 @@ void init_num_cpus()
     //cerr << "num_cpus_result = " << num_cpus_result << endl;
 }
 
+
+/*****************************************************************************/
+/* CPU TOPOLOGY                                                              */
+/*****************************************************************************/
+
+std::vector<int> parseCpuList(const std::string & list)
+{
+    std::vector<int> result;
+
+    const char * p = list.c_str();
+    while (*p && *p != '\n') {
+        char * end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            throw MLDB::Exception("invalid CPU list '%s'", list.c_str());
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+                throw MLDB::Exception("invalid CPU list '%s'", list.c_str());
+            p = end;
+        }
+        for (long cpu = first;  cpu <= last;  ++cpu)
+            result.push_back(cpu);
+        if (*p == ',')
+            ++p;
+        else if (*p && *p != '\n')
+            throw MLDB::Exception("invalid CPU list '%s'", list.c_str());
+    }
+
+    return result;
+}
+
+static bool readFirstLine(const std::string & filename, std::string & line)
+{
+    ifstream stream(filename);
+    return stream && getline(stream, line);
+}
+
+CpuTopology readCpuTopology(const std::string & sysfsDir)
+{
+    CpuTopology result;
+
+    std::string onlineList;
+    std::vector<int> online;
+    if (readFirstLine(sysfsDir + "/cpu/online", onlineList))
+        online = parseCpuList(onlineList);
+    else {
+        for (int i = 0;  i < num_cpus();  ++i)
+            online.push_back(i);
+    }
+
+    int maxCpu = 0;
+    for (int cpu: online)
+        maxCpu = std::max(maxCpu, cpu);
+    std::vector<bool> isOnline(maxCpu + 1, false);
+    for (int cpu: online)
+        isOnline[cpu] = true;
+    result.cpuNode.resize(maxCpu + 1, -1);
+
+    if (DIR * dir = opendir((sysfsDir + "/node").c_str())) {
+        while (dirent * entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4
+                || name.find_first_not_of("0123456789", 4) != string::npos)
+                continue;
+            int node = atoi(name.c_str() + 4);
+
+            std::string cpuList;
+            if (!readFirstLine(sysfsDir + "/node/" + name + "/cpulist",
+                               cpuList))
+                continue;
+
+            if (node >= result.numNodes())
+                result.nodeCpus.resize(node + 1);
+            for (int cpu: parseCpuList(cpuList)) {
+                if (cpu > maxCpu || !isOnline[cpu]
+                    || result.cpuNode[cpu] != -1)
+                    continue;  // offline, or listed twice
+                result.cpuNode[cpu] = node;
+            }
+        }
+        closedir(dir);
+    }
+
+    // CPUs that no node claims, for example without NUMA support, go in
+    // node 0
+    if (result.nodeCpus.empty())
+        result.nodeCpus.resize(1);
+    for (int cpu: online) {
+        if (result.cpuNode[cpu] == -1)
+            result.cpuNode[cpu] = 0;
+    }
+
+    for (int cpu: online)
+        result.nodeCpus[result.cpuNode[cpu]].push_back(cpu);
+
+    return result;
+}
+
+static CpuTopology & currentTopology()
+{
+    static CpuTopology result = readCpuTopology("/sys/devices/system");
+    return result;
+}
+
+const CpuTopology & cpuTopology()
+{
+    return currentTopology();
+}
+
+void setCpuTopology(const CpuTopology & topology)
+{
+    currentTopology() = topology;
+}
+
+int currentNumaNode()
+{
+    const CpuTopology & topology = cpuTopology();
+    if (topology.numNodes() == 1)
+        return 0;
+    return topology.nodeOfCpu(sched_getcpu());
+}
+
 } // namespace MLDB
 
@@ -9,6 +9,8 @@
 #pragma once
 
 #include "mldb/compiler/compiler.h"
+#include <string>
+#include <vector>
 
 namespace MLDB {
 
@@ -24,4 +26,53 @@ MLDB_ALWAYS_INLINE int num_cpus()
     return num_cpus_result;
 }
 
+
+/*****************************************************************************/
+/* CPU TOPOLOGY                                                              */
+/*****************************************************************************/
+
+/** Which CPUs belong to which NUMA node. */
+
+struct CpuTopology {
+    /// For each NUMA node, its online CPUs in increasing order.  Nodes
+    /// with memory but no CPUs have an empty list.
+    std::vector<std::vector<int> > nodeCpus;
+
+    /// For each CPU number, its NUMA node, or -1 if the CPU is offline
+    std::vector<int> cpuNode;
+
+    int numNodes() const
+    {
+        return nodeCpus.size();
+    }
+
+    /// Return the node of the given CPU, or 0 if it's not known
+    int nodeOfCpu(int cpu) const
+    {
+        if (cpu < 0 || cpu >= (int)cpuNode.size() || cpuNode[cpu] == -1)
+            return 0;
+        return cpuNode[cpu];
+    }
+};
+
+/** Parse a Linux CPU list such as "0-3,8,10-11". */
+std::vector<int> parseCpuList(const std::string & list);
+
+/** Read the topology from the sysfs directory given (normally
+    /sys/devices/system).  When there is no NUMA information, the whole
+    machine is one node holding all of the online CPUs.
+*/
+CpuTopology readCpuTopology(const std::string & sysfsDir);
+
+/** Topology of this machine, read once on first use. */
+const CpuTopology & cpuTopology();
+
+/** Replace the topology returned by cpuTopology().  Only useful for tests;
+    it must be called before any other thread uses the topology.
+*/
+void setCpuTopology(const CpuTopology & topology);
+
+/** NUMA node of the CPU the calling thread is currently running on. */
+int currentNumaNode();
+
 } // namespace MLDB
@@ -83,6 +83,14 @@ cpuid(uint32_t request, uint32_t ecx)
     return result;
 }
 
+uint64_t
+xgetbv(uint32_t index)
+{
+    uint32_t eax, edx;
+    asm volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (index));
+    return ((uint64_t)edx << 32) | eax;
+}
+
 uint32_t cpuid_flags()
 {
     return cpuid(1).edx;
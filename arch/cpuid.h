@@ -181,6 +181,12 @@ struct Regs {
 
 Regs cpuid(uint32_t request, uint32_t ecx = 0);
 
+/** Return the given extended control register, which tells which register
+    states the operating system saves.  Only valid if the osxsave flag is
+    set.
+*/
+uint64_t xgetbv(uint32_t index);
+
 #endif // __i686__
 
 } // namespace MLDB
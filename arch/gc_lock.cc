@@ -15,12 +15,16 @@
 #include "mldb/arch/tick_counter.h"
 #include "mldb/arch/spinlock.h"
 #include "mldb/arch/futex.h"
+#include "mldb/arch/cpu_info.h"
 #include "mldb/base/exc_check.h"
 #include "mldb/base/scope.h"
 #include <iterator>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <thread>
 #include <cstring>
+#include <sched.h>
 
 
 using namespace std;
@@ -38,6 +42,13 @@ int32_t gcLockStartingEpoch = 0;
 
 int32_t SpeculativeThreshold = 5;
 
+/** For a sharded lock, the number of shared CS exits a thread makes between
+    attempts to reclaim deferred work, and the number of deferred items
+    after which a defer() will attempt one.
+*/
+static constexpr int ShardedReclaimInterval = 64;
+static constexpr int64_t ShardedDeferBatchSize = 64;
+
 /** A safe comparaison of epochs that deals with potential overflows.
     returns 0 if equal, -1 if a is earlier than b, or 1 if a is greater than b
     \todo So many possible bit twiddling hacks... Must resist...
@@ -254,6 +265,7 @@ GcLockBase::ThreadGcInfoEntry::
 ThreadGcInfoEntry()
     : inEpoch(-1), readLocked(0), writeLocked(0),
       specLocked(0), specUnlocked(0),
+      shard(-1), exitsSinceReclaim(0),
       owner(0)
 {
 }
@@ -395,6 +407,103 @@ struct GcLockBase::Data {
     std::string print() const;
 };
 
+
+/*****************************************************************************/
+/* SHARDS                                                                    */
+/*****************************************************************************/
+
+/** Reader counts for a sharded lock.
+
+    A reader loads the epoch, increments the count for the epoch's parity in
+    the shard of the CPU it's running on, then checks that neither the epoch
+    nor the exclusive flag changed underneath it, retreating and retrying if
+    they did.  Moving the epoch from e to e + 1 is only allowed once no
+    reader is counted under the parity of e + 1 (ie, all readers of e - 1 are
+    gone); work deferred in epoch e can thus run once the epoch reaches
+    e + 2.  Epochs are only advanced under advanceLock.
+*/
+struct GcLockBase::Shards {
+    struct alignas(64) Shard {
+        Shard()
+        {
+            in[0] = in[1] = 0;
+        }
+
+        std::atomic<int64_t> in[2];  ///< Readers in each epoch parity
+    };
+
+    Shards()
+        : numShards(1)
+    {
+        while (numShards < num_cpus())
+            numShards *= 2;
+        shards.reset(new Shard[numShards]);
+        epoch = gcLockStartingEpoch;
+        exclusive = 0;
+        numDeferred = 0;
+        reclaimRequested = false;
+    }
+
+    int numShards;  ///< Always a power of two
+    std::unique_ptr<Shard[]> shards;
+
+    // Read by every reader, written rarely
+    alignas(64) std::atomic<uint32_t> epoch;
+    std::atomic<int> exclusive;    ///< Futex; 1 when an exclusive CS is held
+
+    // Written by the write side only
+    alignas(64) std::atomic<int64_t> numDeferred;  ///< Work not yet run
+    std::atomic<bool> reclaimRequested;
+    std::mutex advanceLock;
+
+    /** Shard for the calling thread, which is that of its current CPU. */
+    int currentShard() const
+    {
+        int cpu = sched_getcpu();
+        if (cpu < 0) {
+            cpu = std::hash<std::thread::id>()(std::this_thread::get_id());
+        }
+        return cpu & (numShards - 1);
+    }
+
+    /** Number of readers in the given epoch parity, or in both if it's -1.
+        This isn't a snapshot, but a reader who is counted through the whole
+        scan will be seen, which is what matters.
+    */
+    int64_t readers(int parity) const
+    {
+        int64_t result = 0;
+        for (int i = 0;  i < numShards;  ++i) {
+            if (parity != 1)
+                result += shards[i].in[0].load(std::memory_order_seq_cst);
+            if (parity != 0)
+                result += shards[i].in[1].load(std::memory_order_seq_cst);
+        }
+        return result;
+    }
+
+    /** Move the epoch on by one, unless there are still readers that would
+        be mixed up with those of the new epoch.  Must be called with
+        advanceLock held.
+    */
+    bool tryAdvance()
+    {
+        uint32_t current = epoch.load(std::memory_order_seq_cst);
+        if (readers((current + 1) & 1) != 0)
+            return false;
+        epoch.store(current + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    /** Back off while waiting for readers to leave. */
+    static void backoff(unsigned iter)
+    {
+        if (iter < 1000)
+            std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+};
+
 inline GcLockBase::Atomic::
 Atomic()
 {
@@ -439,14 +548,35 @@ print() const
 }
 
 GcLockBase::
-GcLockBase()
+GcLockBase(ReaderTracking tracking)
+    : shards(nullptr)
 {
     deferred = new Deferred();
+    if (tracking == RT_SHARDED)
+        shards = new Shards();
 }
 
 GcLockBase::
 ~GcLockBase()
 {
+    if (shards) {
+        // Batched work may still be waiting for an epoch to finish; nothing
+        // can be in a critical section of a lock being destroyed, so it can
+        // all be run now.
+        std::vector<DeferredList *> toRun;
+        {
+            std::lock_guard<Spinlock> guard(deferred->lock);
+            for (auto & e: deferred->entries)
+                toRun.push_back(e.second);
+            deferred->entries.clear();
+        }
+        for (auto * list: toRun) {
+            list->runAll();
+            delete list;
+        }
+        delete shards;
+    }
+
     if (!deferred->empty()) {
         dump();
     }
@@ -512,12 +642,28 @@ runDefers()
         toRun = checkDefers();
     }
 
+    if (shards) {
+        int64_t numToRun = 0;
+        for (auto * list: toRun)
+            numToRun += list->size();
+        shards->numDeferred -= numToRun;
+    }
+
     for (unsigned i = 0;  i < toRun.size();  ++i) {
         toRun[i]->runAll();
         delete toRun[i];
     }
 }
 
+uint32_t
+GcLockBase::
+visibleEpoch() const
+{
+    if (shards)
+        return shards->epoch.load(std::memory_order_seq_cst) - 2;
+    return data->atomic.visibleEpoch();
+}
+
 std::vector<GcLockBase::DeferredList *>
 GcLockBase::
 checkDefers()
@@ -527,7 +673,7 @@ checkDefers()
     while (!deferred->entries.empty() &&
             compareEpochs(
                     deferred->entries.begin()->first,
-                    data->atomic.visibleEpoch()) <= 0)
+                    visibleEpoch()) <= 0)
     {
         result.reserve(deferred->entries.size());
 
@@ -535,7 +681,7 @@ checkDefers()
                  end = deferred->entries.end();
              it != end;  /* no inc */) {
 
-            if (compareEpochs(it->first, data->atomic.visibleEpoch()) > 0)
+            if (compareEpochs(it->first, visibleEpoch()) > 0)
                 break;  // still visible
 
             ExcAssert(it->second);
@@ -558,6 +704,11 @@ enterCS(ThreadGcInfoEntry * entry, RunDefer runDefer)
         
     ExcAssertEqual(entry->inEpoch, -1);
 
+    if (shards) {
+        enterCSSharded(entry);
+        return;
+    }
+
     Atomic current = data->atomic;
 
     for (;;) {
@@ -597,6 +748,11 @@ exitCS(ThreadGcInfoEntry * entry, RunDefer runDefer /* = true */)
     ExcCheck(entry->inEpoch == 0 || entry->inEpoch == 1,
             "Invalid inEpoch");
 
+    if (shards) {
+        exitCSSharded(entry, runDefer);
+        return;
+    }
+
 #if 0
     // Fast path
     if (data->atomic.decrementInAtomic(entry->inEpoch) > 1) {
@@ -624,6 +780,11 @@ enterCSExclusive(ThreadGcInfoEntry * entry)
 {
     ExcAssertEqual(entry->inEpoch, -1);
 
+    if (shards) {
+        enterCSExclusiveSharded(entry);
+        return;
+    }
+
     Atomic current = data->atomic, newValue;
 
     for (;;) {
@@ -702,6 +863,13 @@ exitCSExclusive(ThreadGcInfoEntry * entry)
         throw;
     }
 #endif
+    if (shards) {
+        shards->exclusive.store(0, std::memory_order_seq_cst);
+        futex_wake(shards->exclusive);
+        entry->inEpoch = -1;
+        return;
+    }
+
     data->atomic.resetExclusiveAtomic();
     
     // Wake everything waiting on the exclusive lock
@@ -711,6 +879,132 @@ exitCSExclusive(ThreadGcInfoEntry * entry)
     entry->inEpoch = -1;
 }
 
+void
+GcLockBase::
+enterCSSharded(ThreadGcInfoEntry * entry)
+{
+    for (;;) {
+        uint32_t epoch = shards->epoch.load(std::memory_order_seq_cst);
+        int shard = shards->currentShard();
+        auto & in = shards->shards[shard].in[epoch & 1];
+
+        in.fetch_add(1, std::memory_order_seq_cst);
+
+        // If the epoch moved on between reading it and being counted, a
+        // scan may have missed us; if an exclusive CS started, it's waiting
+        // for us to leave.  Either way, retreat and try again.
+        if (MLDB_LIKELY(shards->epoch.load(std::memory_order_seq_cst) == epoch
+                        && !shards->exclusive.load(std::memory_order_seq_cst))) {
+            entry->inEpoch = epoch & 1;
+            entry->shard = shard;
+            return;
+        }
+
+        in.fetch_sub(1, std::memory_order_seq_cst);
+
+        if (shards->exclusive.load(std::memory_order_seq_cst)) {
+            // We don't check the error, as a spurious wakeup will just
+            // make the loop continue.
+            futex_wait(shards->exclusive, 1);
+        }
+    }
+}
+
+void
+GcLockBase::
+exitCSSharded(ThreadGcInfoEntry * entry, RunDefer runDefer)
+{
+    int64_t before = shards->shards[entry->shard].in[entry->inEpoch]
+        .fetch_sub(1, std::memory_order_seq_cst);
+    ExcAssertGreater(before, 0);
+
+    entry->inEpoch = -1;
+    entry->shard = -1;
+
+    if (!runDefer
+        || shards->numDeferred.load(std::memory_order_relaxed) == 0)
+        return;
+
+    // Scanning the shards is expensive, so we only do it when we may have
+    // been the last reader of our epoch, or once in a while otherwise.
+    if (before == 1 || ++entry->exitsSinceReclaim >= ShardedReclaimInterval) {
+        entry->exitsSinceReclaim = 0;
+        reclaimSharded();
+    }
+}
+
+void
+GcLockBase::
+enterCSExclusiveSharded(ThreadGcInfoEntry * entry)
+{
+    for (;;) {
+        int expected = 0;
+        if (shards->exclusive.compare_exchange_strong
+            (expected, 1, std::memory_order_seq_cst))
+            break;
+        futex_wait(shards->exclusive, 1);
+    }
+
+    // New readers now retreat; wait for those already in to leave
+    for (unsigned i = 0;  shards->readers(-1) != 0;  ++i)
+        Shards::backoff(i);
+
+    entry->inEpoch = shards->epoch.load(std::memory_order_seq_cst) & 1;
+}
+
+void
+GcLockBase::
+visibleBarrierSharded()
+{
+    // Everything currently in a CS is counted under the current epoch or
+    // the one before; once two more have started, they are all gone.
+    uint32_t target = shards->epoch.load(std::memory_order_seq_cst) + 2;
+
+    {
+        std::lock_guard<std::mutex> guard(shards->advanceLock);
+        for (unsigned i = 0;
+             compareEpochs(shards->epoch.load(std::memory_order_seq_cst),
+                           target) < 0;
+             ++i) {
+            if (!shards->tryAdvance())
+                Shards::backoff(i);
+        }
+    }
+
+    if (shards->numDeferred.load(std::memory_order_relaxed))
+        runDefers();
+}
+
+void
+GcLockBase::
+reclaimSharded()
+{
+    std::unique_lock<std::mutex> guard(shards->advanceLock, std::defer_lock);
+    if (!guard.try_lock()) {
+        // Ask the thread that holds it to go around again once it's done,
+        // as it may have scanned before our reader left.
+        shards->reclaimRequested.store(true, std::memory_order_seq_cst);
+        if (!guard.try_lock())
+            return;
+    }
+
+    for (;;) {
+        if (shards->tryAdvance())
+            shards->tryAdvance();
+        guard.unlock();
+
+        runDefers();
+
+        if (!shards->reclaimRequested.exchange(false, std::memory_order_seq_cst))
+            return;
+
+        // If someone else has the lock, they started after the request was
+        // made and so will take care of it.
+        if (!guard.try_lock())
+            return;
+    }
+}
+
 void
 GcLockBase::
 visibleBarrier()
@@ -723,6 +1017,11 @@ visibleBarrier()
         throw MLDB::Exception("visibleBarrier called in critical section will "
                             "deadlock");
 
+    if (shards) {
+        visibleBarrierSharded();
+        return;
+    }
+
     Atomic current = data->atomic;
     int startEpoch = data->atomic.epoch;
     
@@ -767,6 +1066,13 @@ deferBarrier()
 
     visibleBarrier();
 
+    if (shards) {
+        // Everything deferred before the barrier belongs to an epoch that's
+        // now invisible, so a single pass will run it.
+        runDefers();
+        return;
+    }
+
     // Do it twice to make sure that everything is cycled over two different
     // epochs
     for (unsigned i = 0;  i < 2;  ++i) {
@@ -833,6 +1139,33 @@ doDefer(void (fn) (Args...), Args... args)
     // If there are threads in the current epoch (irrespective of the old
     // epoch) then we need to wait until the current epoch is done.
 
+    if (shards) {
+        // Finding out whether anyone is in a critical section would need a
+        // scan of all shards, so the work is added to the current epoch's
+        // batch and reclaimed when the epoch ends.  The fence makes sure
+        // that whatever the caller just unlinked is visible before we read
+        // the epoch.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int32_t epoch = shards->epoch.load(std::memory_order_seq_cst);
+        {
+            std::lock_guard<Spinlock> guard(deferred->lock);
+            auto epochIt
+                = deferred->entries.insert
+                (make_pair(epoch, (DeferredList *)0)).first;
+            if (epochIt->second == 0)
+                epochIt->second = new DeferredList();
+            epochIt->second->addDeferred(epoch, fn,
+                                         std::forward<Args>(args)...);
+        }
+
+        // Reclaim when the first item arrives, so that lone deferrals don't
+        // wait for the next one, and then once per batch.
+        int64_t before = shards->numDeferred.fetch_add(1);
+        if (before == 0 || (before + 1) % ShardedDeferBatchSize == 0)
+            reclaimSharded();
+        return;
+    }
+
     Atomic current = data->atomic;
 
     int32_t newestVisibleEpoch = current.epoch;
@@ -922,10 +1255,20 @@ void
 GcLockBase::
 dump()
 {
-    Atomic current = data->atomic;
-    cerr << "epoch " << current.epoch << " in " << current.anyInCurrent()
-         << " in-1 " << current.anyInOld() << " vis " << current.visibleEpoch()
-         << " excl " << current.exclusive() << endl;
+    if (shards) {
+        uint32_t epoch = shards->epoch.load();
+        cerr << "epoch " << epoch << " in " << shards->readers(epoch & 1)
+             << " in-1 " << shards->readers((epoch - 1) & 1)
+             << " vis " << visibleEpoch()
+             << " excl " << shards->exclusive.load()
+             << " shards " << shards->numShards << endl;
+    }
+    else {
+        Atomic current = data->atomic;
+        cerr << "epoch " << current.epoch << " in " << current.anyInCurrent()
+             << " in-1 " << current.anyInOld() << " vis " << current.visibleEpoch()
+             << " excl " << current.exclusive() << endl;
+    }
     cerr << "deferred: ";
     {
         std::lock_guard<Spinlock> guard(deferred->lock);
@@ -944,6 +1287,8 @@ int
 GcLockBase::
 currentEpoch() const
 {
+    if (shards)
+        return shards->epoch.load();
     return data->atomic.epoch;
 }
 
@@ -951,6 +1296,8 @@ bool
 GcLockBase::
 isLockedByAnyThread() const
 {
+    if (shards)
+        return shards->readers(-1) != 0 || shards->exclusive.load();
     return data->atomic.in[0] || data->atomic.in[1] ;
 }
 
@@ -973,8 +1320,9 @@ uninitializedConstructData(void * memory)
 /*****************************************************************************/
 
 GcLock::
-GcLock()
-    : localData(new Data())
+GcLock(ReaderTracking tracking)
+    : GcLockBase(tracking),
+      localData(new Data())
 {
     data = localData.get();
 }
@@ -39,6 +39,16 @@
     Further details is available in the documentation of each respective
     operand.
 
+    By default the reader counts of all threads live in a single shared word,
+    which makes every shared CS entry and exit write to the same cache line.
+    With many threads taking shared CSs on a hot path, that line bounces
+    between cores.  A lock constructed with RT_SHARDED (or a ShardedGcLock)
+    instead keeps a padded pair of reader counts per CPU, so that readers
+    only touch their own CPU's line.  The price is paid on the write side:
+    advancing the epoch needs a scan over all of the shards, so deferred
+    work is batched per epoch and reclaimed together rather than being
+    checked on every CS exit.  Sharded locks are only for use within a
+    single process.
 */
 
 namespace MLDB {
@@ -65,6 +75,14 @@ public:
         RD_YES = 1      ///< Potentially run deferred work on this call
     };
 
+    /** How the lock keeps track of the threads in a shared critical
+        section.
+    */
+    enum ReaderTracking {
+        RT_SHARED = 0,  ///< One word of reader counts, shared by all threads
+        RT_SHARDED = 1  ///< Reader counts sharded per CPU
+    };
+
     /// A thread's bookkeeping info about each GC area
     struct ThreadGcInfoEntry {
         ThreadGcInfoEntry();
@@ -77,6 +95,9 @@ public:
         int specLocked;
         int specUnlocked;
 
+        int shard;              ///< Shard holding our reader count if sharded
+        int exitsSinceReclaim;  ///< CS exits since we last tried to reclaim
+
         GcLockBase *owner;
 
         void init(const GcLockBase * const self);
@@ -116,7 +137,7 @@ public:
         //return *gcInfo.get(info);
     }
 
-    GcLockBase();
+    GcLockBase(ReaderTracking tracking = RT_SHARED);
 
     virtual ~GcLockBase();
 
@@ -330,10 +351,12 @@ protected:
 private:
     struct Deferred;
     struct DeferredList;
+    struct Shards;
 
     GcInfo gcInfo;
 
     Deferred * deferred;   ///< Deferred workloads (hidden structure)
+    Shards * shards;       ///< Per CPU reader counts; null unless RT_SHARDED
 
     /** Update with the new value after first checking that the current
         value is the same as the old value.  Returns true if it
@@ -354,6 +377,22 @@ private:
         called with deferred locked.
     */
     std::vector<DeferredList *> checkDefers();
+
+    /** Most recent epoch whose deferred work may be run. */
+    uint32_t visibleEpoch() const;
+
+    /** Sharded versions of the critical section operations. */
+    void enterCSSharded(ThreadGcInfoEntry * entry);
+    void exitCSSharded(ThreadGcInfoEntry * entry, RunDefer runDefer);
+    void enterCSExclusiveSharded(ThreadGcInfoEntry * entry);
+    void visibleBarrierSharded();
+
+    /** Advance the epoch of a sharded lock as far as the readers allow and
+        run the deferred work that has become invisible.  Never blocks; if
+        another thread is already doing it, that thread is asked to go
+        around again.
+    */
+    void reclaimSharded();
 };
 
 
@@ -365,7 +404,7 @@ private:
 
 struct GcLock : public GcLockBase
 {
-    GcLock();
+    GcLock(ReaderTracking tracking = RT_SHARED);
     virtual ~GcLock();
 
     virtual void unlink();
@@ -374,4 +413,21 @@ private:
     std::unique_ptr<Data> localData;
 };
 
+
+/*****************************************************************************/
+/* SHARDED GC LOCK                                                           */
+/*****************************************************************************/
+
+/** GcLock whose reader counts are sharded per CPU, for locks that are taken
+    shared by many threads at once.
+*/
+
+struct ShardedGcLock : public GcLock
+{
+    ShardedGcLock()
+        : GcLock(RT_SHARDED)
+    {
+    }
+};
+
 } // namespace MLDB
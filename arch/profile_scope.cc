@@ -0,0 +1,298 @@
+/* profile_scope.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Instrumentation of hot paths that can be switched on in production.
+*/
+
+#include "profile_scope.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+
+
+namespace MLDB {
+
+std::atomic<bool> profilingEnabled(false);
+
+namespace {
+
+uint64_t nowNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* THREAD PROFILE                                                            */
+/*****************************************************************************/
+
+/** What one thread recorded during the current session, as a tree of the
+    stacks of points that it entered.  The mutex is only ever contended
+    when a session starts or stops.
+*/
+
+struct ThreadProfile {
+    struct Node {
+        Node(const ProfilePoint * point = nullptr, uint32_t parent = 0)
+            : point(point), parent(parent)
+        {
+        }
+
+        const ProfilePoint * point;
+        uint32_t parent;
+        std::vector<uint32_t> children;
+        uint64_t count = 0;
+        uint64_t nanos = 0;         ///< Time spent within the node
+        uint64_t childNanos = 0;    ///< Of which in its children
+    };
+
+    ThreadProfile(uint32_t generation)
+    {
+        reset(generation);
+    }
+
+    std::mutex mutex;
+    std::vector<Node> nodes;        ///< The first one is the root
+    uint32_t current;               ///< Node of the innermost open scope
+    uint32_t generation;            ///< Session that the nodes belong to
+    bool used;                      ///< Has a scope been entered?
+
+    void reset(uint32_t newGeneration)
+    {
+        nodes.clear();
+        nodes.emplace_back();
+        current = 0;
+        generation = newGeneration;
+        used = false;
+    }
+};
+
+namespace {
+
+struct ProfileRegistry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadProfile> > threads;
+    uint32_t generation = 0;
+    bool running = false;
+    uint64_t startNanos = 0;
+};
+
+ProfileRegistry & getRegistry()
+{
+    // Never destroyed, as threads may still use it during exit
+    static ProfileRegistry * registry = new ProfileRegistry();
+    return *registry;
+}
+
+ThreadProfile * getThreadProfile()
+{
+    static thread_local std::shared_ptr<ThreadProfile> profile;
+    if (MLDB_UNLIKELY(!profile)) {
+        ProfileRegistry & registry = getRegistry();
+        std::unique_lock<std::mutex> guard(registry.mutex);
+        profile = std::make_shared<ThreadProfile>(registry.generation);
+        registry.threads.push_back(profile);
+    }
+    return profile.get();
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* PROFILE SCOPE                                                             */
+/*****************************************************************************/
+
+void
+ProfileScope::
+enter(const ProfilePoint & point)
+{
+    ThreadProfile * profile = getThreadProfile();
+    {
+        std::unique_lock<std::mutex> guard(profile->mutex);
+        uint32_t parent = profile->current;
+        const ProfilePoint * outer = profile->nodes[parent].point;
+        if (outer && (outer == &point
+                      || strcmp(outer->name, point.name) == 0))
+            return;  // recursive; the outer scope covers it
+
+        uint32_t child = 0;
+        for (uint32_t c: profile->nodes[parent].children) {
+            if (profile->nodes[c].point == &point) {
+                child = c;
+                break;
+            }
+        }
+
+        if (child == 0) {
+            child = profile->nodes.size();
+            profile->nodes.emplace_back(&point, parent);
+            profile->nodes[parent].children.push_back(child);
+        }
+
+        profile->current = child;
+        profile->used = true;
+        this->node = child;
+        this->generation = profile->generation;
+    }
+
+    this->thread = profile;
+    this->start = nowNanos();
+}
+
+void
+ProfileScope::
+exit()
+{
+    uint64_t elapsed = nowNanos() - start;
+
+    std::unique_lock<std::mutex> guard(thread->mutex);
+
+    // Entered before the current session started; its node is gone
+    if (thread->generation != generation)
+        return;
+
+    ThreadProfile::Node & entry = thread->nodes[node];
+    entry.count += 1;
+    entry.nanos += elapsed;
+    thread->nodes[entry.parent].childNanos += elapsed;
+    thread->current = entry.parent;
+}
+
+
+/*****************************************************************************/
+/* PROFILE REPORT                                                            */
+/*****************************************************************************/
+
+std::string
+ProfileReport::
+folded() const
+{
+    std::string result;
+    for (auto & stack: stacks) {
+        for (size_t i = 0;  i < stack.names.size();  ++i) {
+            if (i != 0)
+                result += ';';
+            result += stack.names[i];
+        }
+        result += ' ';
+        result += std::to_string((uint64_t)(stack.selfSeconds * 1000000.0
+                                            + 0.5));
+        result += '\n';
+    }
+    return result;
+}
+
+
+/*****************************************************************************/
+/* PROFILING SESSIONS                                                        */
+/*****************************************************************************/
+
+bool startProfiling()
+{
+    ProfileRegistry & registry = getRegistry();
+    std::unique_lock<std::mutex> guard(registry.mutex);
+    if (registry.running)
+        return false;
+
+    registry.generation += 1;
+
+    // Forget threads that have exited, which only the registry refers to
+    registry.threads.erase
+        (std::remove_if(registry.threads.begin(), registry.threads.end(),
+                        [] (const std::shared_ptr<ThreadProfile> & profile)
+                        {
+                            return profile.use_count() == 1;
+                        }),
+         registry.threads.end());
+
+    for (auto & profile: registry.threads) {
+        std::unique_lock<std::mutex> threadGuard(profile->mutex);
+        profile->reset(registry.generation);
+    }
+
+    registry.running = true;
+    registry.startNanos = nowNanos();
+    profilingEnabled.store(true);
+    return true;
+}
+
+ProfileReport stopProfiling()
+{
+    ProfileReport result;
+
+    ProfileRegistry & registry = getRegistry();
+    std::unique_lock<std::mutex> guard(registry.mutex);
+    if (!registry.running)
+        return result;
+
+    profilingEnabled.store(false);
+    registry.running = false;
+    result.seconds = (nowNanos() - registry.startNanos) / 1e9;
+
+    std::map<std::vector<std::string>, ProfileReport::Stack> stacks;
+    std::map<std::string, ProfileReport::Point> points;
+
+    for (auto & profile: registry.threads) {
+        std::unique_lock<std::mutex> threadGuard(profile->mutex);
+        if (!profile->used)
+            continue;
+        result.numThreads += 1;
+
+        // Parents always come before their children
+        const auto & nodes = profile->nodes;
+        std::vector<std::vector<std::string> > names(nodes.size());
+        for (size_t i = 1;  i < nodes.size();  ++i) {
+            const ThreadProfile::Node & node = nodes[i];
+            names[i] = names[node.parent];
+            names[i].emplace_back(node.point->name);
+
+            double total = node.nanos / 1e9;
+            double self = (node.nanos - std::min(node.nanos, node.childNanos))
+                / 1e9;
+
+            ProfileReport::Stack & stack = stacks[names[i]];
+            stack.count += node.count;
+            stack.totalSeconds += total;
+            stack.selfSeconds += self;
+
+            ProfileReport::Point & point = points[node.point->name];
+            point.count += node.count;
+            point.selfSeconds += self;
+
+            // Time under an outer scope of the same name is already counted
+            bool nested = false;
+            for (size_t j = 0;  j + 1 < names[i].size() && !nested;  ++j)
+                nested = names[i][j] == names[i].back();
+            if (!nested)
+                point.totalSeconds += total;
+        }
+    }
+
+    for (auto & s: stacks) {
+        s.second.names = s.first;
+        result.stacks.emplace_back(std::move(s.second));
+    }
+
+    for (auto & p: points) {
+        p.second.name = p.first;
+        result.points.emplace_back(std::move(p.second));
+    }
+
+    std::stable_sort(result.points.begin(), result.points.end(),
+                     [] (const ProfileReport::Point & p1,
+                         const ProfileReport::Point & p2)
+                     {
+                         return p1.totalSeconds > p2.totalSeconds;
+                     });
+
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,155 @@
+/* profile_scope.h                                                 -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Instrumentation of hot paths that can be switched on in production.
+
+   Scopes are placed at key points of the code.  While profiling is off,
+   entering one costs a single relaxed load and a branch.  While it's on,
+   each thread records the time spent under each stack of nested scopes,
+   which is aggregated over all threads into a report that can be turned
+   into a flame graph.
+*/
+
+#pragma once
+
+#include "mldb/compiler/compiler.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace MLDB {
+
+struct ThreadProfile;
+
+
+/*****************************************************************************/
+/* PROFILE POINT                                                             */
+/*****************************************************************************/
+
+/** A named point in the code whose scopes are timed.  Points are normally
+    static objects next to the code.  Points with the same name are
+    reported together.  Names shouldn't contain ';' or spaces, which are separators in
+    the folded stacks of a flame graph.
+*/
+
+struct ProfilePoint {
+    constexpr ProfilePoint(const char * name)
+        : name(name)
+    {
+    }
+
+    const char * name;
+};
+
+
+/*****************************************************************************/
+/* PROFILE SCOPE                                                             */
+/*****************************************************************************/
+
+/// Is profiling on?  Read with a relaxed load by every scope.
+extern std::atomic<bool> profilingEnabled;
+
+/** Times the scope in which it lives against a point, when profiling is
+    on.  A scope that's entered directly within another scope of a point
+    with the same name (eg, recursively) isn't timed separately, so recursive code doesn't
+    produce deep stacks.
+*/
+
+struct ProfileScope {
+    ProfileScope(const ProfilePoint & point)
+        : thread(nullptr)
+    {
+        if (MLDB_UNLIKELY(profilingEnabled.load(std::memory_order_relaxed)))
+            enter(point);
+    }
+
+    ~ProfileScope()
+    {
+        if (MLDB_UNLIKELY(thread != nullptr))
+            exit();
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    void operator = (const ProfileScope &) = delete;
+
+private:
+    ThreadProfile * thread;  ///< Null unless this scope is being timed
+    uint32_t node;           ///< Node of the stack that this scope entered
+    uint32_t generation;     ///< Session in which this scope was entered
+    uint64_t start;          ///< Time it was entered, in nanoseconds
+
+    void enter(const ProfilePoint & point);
+    void exit();
+};
+
+#define MLDB_PROFILE_CONCAT2(x, y) x ## y
+#define MLDB_PROFILE_CONCAT(x, y) MLDB_PROFILE_CONCAT2(x, y)
+
+/** Time the rest of the enclosing block against a point with the given
+    name, which must be a string literal.
+*/
+#define MLDB_PROFILE_SCOPE(name)                                        \
+    static constexpr ::MLDB::ProfilePoint                               \
+        MLDB_PROFILE_CONCAT(mldbProfilePoint, __LINE__)(name);          \
+    ::MLDB::ProfileScope MLDB_PROFILE_CONCAT(mldbProfileScope, __LINE__) \
+        (MLDB_PROFILE_CONCAT(mldbProfilePoint, __LINE__))
+
+
+/*****************************************************************************/
+/* PROFILE REPORT                                                            */
+/*****************************************************************************/
+
+/** Aggregated result of a profiling session, over all threads. */
+
+struct ProfileReport {
+    double seconds = 0;       ///< Wall time over which profiling was on
+    int numThreads = 0;       ///< Threads that entered at least one scope
+
+    /// Totals for each point
+    struct Point {
+        std::string name;
+        uint64_t count = 0;         ///< Number of scopes timed
+        double totalSeconds = 0;    ///< Time within the scopes
+        double selfSeconds = 0;     ///< Time not within a nested scope
+    };
+
+    /// Sorted by decreasing total time
+    std::vector<Point> points;
+
+    /// Totals for each stack of nested points
+    struct Stack {
+        std::vector<std::string> names;  ///< Outermost first
+        uint64_t count = 0;
+        double totalSeconds = 0;
+        double selfSeconds = 0;
+    };
+
+    /// Sorted by their names
+    std::vector<Stack> stacks;
+
+    /** Return the stacks in the folded format that is read by flame graph
+        tools: one line per stack, with the names separated by ';' then a
+        space and the self time in microseconds.
+    */
+    std::string folded() const;
+};
+
+
+/*****************************************************************************/
+/* PROFILING SESSIONS                                                        */
+/*****************************************************************************/
+
+/** Forget anything that was recorded, and switch profiling on.  Returns
+    false, and does nothing, if a session is already running.
+*/
+bool startProfiling();
+
+/** Switch profiling off, and return what was recorded since
+    startProfiling().  Scopes that are still open at this point aren't
+    included.
+*/
+ProfileReport stopProfiling();
+
+} // namespace MLDB
@@ -53,6 +53,18 @@ MLDB_ALWAYS_INLINE bool has_avx2()
     return cpuid(7, 0).ebx & (1 << 5);
 }
 
+MLDB_ALWAYS_INLINE bool has_fma() { return cpu_info().fma; }
+
+MLDB_ALWAYS_INLINE bool has_f16c() { return cpu_info().f16c; }
+
+MLDB_ALWAYS_INLINE bool has_avx512f()
+{
+    // The OS also needs to save the opmask and upper zmm registers
+    return has_avx()
+        && (cpuid(7, 0).ebx & (1 << 16))
+        && (xgetbv(0) & 0xe6) == 0xe6;
+}
+
 #endif // __i686__
 
 } // namespace MLDB
@@ -10,11 +10,17 @@
 #include "mldb/arch/arch.h"
 #include "mldb/compiler/compiler.h"
 #include "exception.h"
+#include "simd_vector.h"
 #include <iostream>
 #include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
+#include <atomic>
 #if MLDB_INTEL_ISA
-# include "simd_vector.h"
 # include "simd_vector_avx.h"
+# include "simd_vector_avx2.h"
+# include "simd_vector_avx512.h"
 # include "sse2.h"
 # include <immintrin.h>
 #endif
@@ -1841,6 +1847,405 @@ void vec_min_max_el(const float * x, float * mins, float * maxs, size_t n)
     }
 }
 
+void vec_dotprod_many(const float * x, const float * const * ys,
+                      float * r, size_t ny, size_t n)
+{
+    mat_dotprod(&x, 1, ys, ny, r, n);
+}
+
+void vec_euclid_many(const float * x, const float * const * ys,
+                     float * r, size_t ny, size_t n)
+{
+    switch (simdIsa()) {
+#if MLDB_INTEL_ISA
+    case Isa::AVX512:
+        Avx512::vec_euclid_many(x, ys, r, ny, n);
+        return;
+    case Isa::AVX2:
+        Avx2::vec_euclid_many(x, ys, r, ny, n);
+        return;
+#endif
+    default:
+        for (size_t j = 0;  j < ny;  ++j)
+            r[j] = vec_euclid(x, ys[j], n);
+    }
+}
+
+void mat_dotprod(const float * const * xs, size_t nx,
+                 const float * const * ys, size_t ny,
+                 float * r, size_t n)
+{
+    switch (simdIsa()) {
+#if MLDB_INTEL_ISA
+    case Isa::AVX512:
+        Avx512::mat_dotprod(xs, nx, ys, ny, r, n);
+        return;
+    case Isa::AVX2:
+        Avx2::mat_dotprod(xs, nx, ys, ny, r, n);
+        return;
+#endif
+    default:
+        for (size_t i = 0;  i < nx;  ++i)
+            for (size_t j = 0;  j < ny;  ++j)
+                r[i * ny + j] = vec_dotprod(xs[i], ys[j], n);
+    }
+}
+
+void vec_min_max(const float * x, size_t n, float & lowest, float & highest)
+{
+    switch (simdIsa()) {
+#if MLDB_INTEL_ISA
+    case Isa::AVX512:
+        Avx512::vec_min_max(x, n, lowest, highest);
+        return;
+    case Isa::AVX2:
+        Avx2::vec_min_max(x, n, lowest, highest);
+        return;
+#endif
+    default:
+        break;
+    }
+
+    // Several independent accumulators so that the compiler can vectorize
+    // the loop
+    enum { LANES = 8 };
+    size_t i = 0;
+    float mins[LANES], maxs[LANES];
+    std::fill(mins, mins + LANES, x[0]);
+    std::fill(maxs, maxs + LANES, x[0]);
+    for (;  i + LANES <= n;  i += LANES) {
+        for (int j = 0;  j < LANES;  ++j) {
+            mins[j] = std::min(mins[j], x[i + j]);
+            maxs[j] = std::max(maxs[j], x[i + j]);
+        }
+    }
+    for (;  i < n;  ++i) {
+        mins[0] = std::min(mins[0], x[i]);
+        maxs[0] = std::max(maxs[0], x[i]);
+    }
+    lowest = *std::min_element(mins, mins + LANES);
+    highest = *std::max_element(maxs, maxs + LANES);
+}
+
+void vec_prefix_sum(const uint64_t * x, uint64_t * r, size_t n)
+{
+    switch (simdIsa()) {
+#if MLDB_INTEL_ISA
+    case Isa::AVX512:
+    case Isa::AVX2:
+        Avx2::vec_prefix_sum(x, r, n);
+        return;
+#endif
+    default:
+        break;
+    }
+
+    uint64_t total = 0;
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = total += x[i];
+}
+
+void vec_gather(const float * table, const uint32_t * indexes, float * r,
+                size_t n)
+{
+    switch (simdIsa()) {
+#if MLDB_INTEL_ISA
+    case Isa::AVX512:
+        Avx512::vec_gather(table, indexes, r, n);
+        return;
+    case Isa::AVX2:
+        Avx2::vec_gather(table, indexes, r, n);
+        return;
+#endif
+    default:
+        break;
+    }
+
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = table[indexes[i]];
+}
+
+void vec_unpack_bits(const uint64_t * words, size_t numWords,
+                     size_t firstBit, int width, uint64_t * r, size_t n)
+{
+    if (width == 0) {
+        std::fill(r, r + n, 0);
+        return;
+    }
+
+    // Values of up to 57 bits fit in the 8 bytes starting at the byte that
+    // holds their first bit, so can be read with a single unaligned load as
+    // long as those 8 bytes are within the stream.
+    size_t nFast = 0;
+    if (width <= 57 && numWords > 0) {
+        size_t limitBits = (numWords * 8 - 7) * 8;
+        if (firstBit < limitBits)
+            nFast = std::min(n, (limitBits - firstBit + width - 1) / width);
+    }
+
+    switch (simdIsa()) {
+#if MLDB_INTEL_ISA
+    case Isa::AVX512:
+        Avx512::vec_unpack_bits(words, firstBit, width, r, nFast);
+        break;
+    case Isa::AVX2:
+        Avx2::vec_unpack_bits(words, firstBit, width, r, nFast);
+        break;
+#endif
+    default: {
+        const char * bytes = (const char *)words;
+        uint64_t mask = (uint64_t(1) << width) - 1;
+        for (size_t i = 0;  i < nFast;  ++i) {
+            size_t bit = firstBit + i * width;
+            uint64_t val;
+            std::memcpy(&val, bytes + bit / 8, 8);
+            r[i] = (val >> (bit % 8)) & mask;
+        }
+    }
+    }
+
+    uint64_t mask = width == 64 ? uint64_t(-1) : (uint64_t(1) << width) - 1;
+    for (size_t i = nFast;  i < n;  ++i) {
+        size_t bit = firstBit + i * width;
+        size_t word = bit / 64, shift = bit % 64;
+        uint64_t val = words[word] >> shift;
+        if (shift + width > 64)
+            val |= words[word + 1] << (64 - shift);
+        r[i] = val & mask;
+    }
+}
+
+namespace {
+
+float halfToFloat(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    int exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t x;
+
+    if (exponent == 0) {
+        if (mantissa == 0)
+            x = sign;
+        else {
+            // Subnormal; normalize it
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                --exponent;
+            }
+            x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    }
+    else if (exponent == 31)
+        x = sign | 0x7f800000 | (mantissa << 13);
+    else x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+
+    float result;
+    std::memcpy(&result, &x, sizeof(result));
+    return result;
+}
+
+} // file scope
+
+void vec_half_to_float(const uint16_t * x, float * r, size_t n)
+{
+    switch (simdIsa()) {
+#if MLDB_INTEL_ISA
+    case Isa::AVX512:
+    case Isa::AVX2:
+        Avx2::vec_half_to_float(x, r, n);
+        return;
+#endif
+    default:
+        break;
+    }
+
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = halfToFloat(x[i]);
+}
+
+void vec_dequantize(const uint8_t * x, float lowest, float scale, float * r,
+                    size_t n)
+{
+    switch (simdIsa()) {
+#if MLDB_INTEL_ISA
+    case Isa::AVX512:
+    case Isa::AVX2:
+        Avx2::vec_dequantize(x, lowest, scale, r, n);
+        return;
+#endif
+    default:
+        break;
+    }
+
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = lowest + scale * x[i];
+}
+
+namespace {
+
+inline bool isJsonStringSpecial(char c)
+{
+    return (unsigned char)c < ' ' || (unsigned char)c >= 0x7f
+        || c == '"' || c == '\\';
+}
+
+inline bool isJsonWhitespace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+/** Set the high bit of the bytes of x that are zero.  Those above the
+    first zero byte may be set wrongly, so only the lowest set bit can be
+    relied on.
+*/
+inline uint64_t zeroBytes(uint64_t x)
+{
+    return (x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL;
+}
+
+} // file scope
+
+size_t vec_json_string_run(const char * p, size_t n)
+{
+    switch (simdIsa()) {
+#if MLDB_INTEL_ISA
+    case Isa::AVX512:
+    case Isa::AVX2:
+        return Avx2::vec_json_string_run(p, n);
+#endif
+    default:
+        break;
+    }
+
+    // Eight bytes at a time, with the usual bit tricks; on little endian
+    // machines the lowest set bit is the first special byte
+    size_t i = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    const uint64_t ones = 0x0101010101010101ULL;
+    for (;  i + 8 <= n;  i += 8) {
+        uint64_t x;
+        std::memcpy(&x, p + i, 8);
+        uint64_t special
+            = ((x - ones * ' ') & ~x & 0x8080808080808080ULL)  // < ' '
+            | (x & 0x8080808080808080ULL)                      // >= 0x80
+            | zeroBytes(x ^ (ones * '"'))
+            | zeroBytes(x ^ (ones * '\\'))
+            | zeroBytes(x ^ (ones * 0x7f));
+        if (special)
+            return i + __builtin_ctzll(special) / 8;
+    }
+#endif
+
+    for (;  i < n && !isJsonStringSpecial(p[i]);  ++i) ;
+    return i;
+}
+
+size_t vec_json_whitespace_run(const char * p, size_t n)
+{
+    // Most runs of whitespace are a few characters of indentation, which
+    // are quicker to look at one by one than to load as a block
+    size_t i = 0;
+    for (;  i < n && i < 16;  ++i) {
+        if (!isJsonWhitespace(p[i]))
+            return i;
+    }
+
+    switch (simdIsa()) {
+#if MLDB_INTEL_ISA
+    case Isa::AVX512:
+    case Isa::AVX2:
+        return i + Avx2::vec_json_whitespace_run(p + i, n - i);
+#endif
+    default:
+        break;
+    }
+
+    for (;  i < n && isJsonWhitespace(p[i]);  ++i) ;
+    return i;
+}
+
 } // namespace Generic
+
+
+/*****************************************************************************/
+/* INSTRUCTION SET DISPATCH                                                  */
+/*****************************************************************************/
+
+namespace {
+
+bool isaSupported(Isa isa)
+{
+    switch (isa) {
+    case Isa::GENERIC:
+        return true;
+#if MLDB_INTEL_ISA
+    case Isa::AVX2:
+        return has_avx() && has_avx2() && has_fma() && has_f16c();
+    case Isa::AVX512:
+        return has_avx512f() && isaSupported(Isa::AVX2);
+#endif
+    default:
+        return false;
+    }
+}
+
+/** The dispatched kernels are called in inner loops, so the cpuid flags
+    are only interrogated once.
+*/
+std::atomic<Isa> & currentIsa()
+{
+    static std::atomic<Isa> result([] ()
+        {
+            Isa isa = bestSupportedIsa();
+            const char * requested = getenv("MLDB_SIMD_ISA");
+            if (!requested)
+                return isa;
+            for (Isa lower: { Isa::GENERIC, Isa::AVX2, Isa::AVX512 }) {
+                if (strcmp(requested, isaName(lower)) == 0)
+                    return std::min(isa, lower);
+            }
+            cerr << "warning: unknown MLDB_SIMD_ISA value " << requested
+                 << "; using " << isaName(isa) << endl;
+            return isa;
+        } ());
+    return result;
+}
+
+} // file scope
+
+Isa bestSupportedIsa()
+{
+    for (Isa isa: { Isa::AVX512, Isa::AVX2 }) {
+        if (isaSupported(isa))
+            return isa;
+    }
+    return Isa::GENERIC;
+}
+
+Isa simdIsa()
+{
+    return currentIsa().load(std::memory_order_relaxed);
+}
+
+Isa setSimdIsa(Isa isa)
+{
+    if (!isaSupported(isa))
+        throw Exception("CPU does not support the %s instruction set",
+                        isaName(isa));
+    return currentIsa().exchange(isa);
+}
+
+const char * isaName(Isa isa)
+{
+    switch (isa) {
+    case Isa::GENERIC: return "generic";
+    case Isa::AVX2:    return "avx2";
+    case Isa::AVX512:  return "avx512";
+    }
+    return "unknown";
+}
+
 } // namespace SIMD
 } // namespace MLDB
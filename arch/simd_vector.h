@@ -10,9 +10,42 @@
 
 #include "simd.h"
 #include "mldb/arch/arch.h"
+#include <cstdint>
+#include <cstddef>
 
 namespace MLDB {
 namespace SIMD {
+
+/** Instruction sets that the dispatched kernels (the batched kernels
+    and the ones below them) have versions for.  Other x86 CPUs and other
+    architectures use the generic versions, which are written so that the
+    compiler can vectorize them for the baseline instruction set (SSE2 or
+    NEON).
+*/
+enum class Isa {
+    GENERIC,
+    AVX2,     ///< Also needs FMA and F16C
+    AVX512    ///< AVX-512F, as well as everything AVX2 needs
+};
+
+/** Instruction set the dispatched kernels use.  It's chosen from the cpuid
+    flags the first time it's needed, unless the MLDB_SIMD_ISA environment
+    variable ("generic", "avx2" or "avx512") asks for a lower one.
+*/
+Isa simdIsa();
+
+/** Make the dispatched kernels use the given instruction set, returning
+    the previous one.  Throws if the CPU doesn't support it.  This is
+    mostly useful for testing and benchmarking the different versions.
+*/
+Isa setSimdIsa(Isa isa);
+
+/** Return the best instruction set the CPU supports. */
+Isa bestSupportedIsa();
+
+/** Return the name of the instruction set, as used by MLDB_SIMD_ISA. */
+const char * isaName(Isa isa);
+
 namespace Generic {
 
 /* Float versions */
@@ -170,6 +203,62 @@ void vec_min_max_el(const float * x, float * mins, float * maxs, size_t n);
 // Euclidean distance squared: sum((p - q)^2)
 double vec_euclid(const float * p, const float * q, size_t n);
 
+/* Batched kernels, comparing vectors of n floats.  These are dispatched to
+   AVX-512 or AVX2 versions at runtime, and accumulate in single precision.
+*/
+
+// Dot product of x with each of the ny vectors in ys: r[j] = x . ys[j]
+void vec_dotprod_many(const float * x, const float * const * ys,
+                      float * r, size_t ny, size_t n);
+
+// Euclidean distance squared from x to each of the ny vectors in ys
+void vec_euclid_many(const float * x, const float * const * ys,
+                     float * r, size_t ny, size_t n);
+
+// Dot product of each of the nx vectors in xs with each of the ny vectors
+// in ys (a small matrix multiplication): r[i * ny + j] = xs[i] . ys[j]
+void mat_dotprod(const float * const * xs, size_t nx,
+                 const float * const * ys, size_t ny,
+                 float * r, size_t n);
+
+/* Kernels for scans and decoding.  These are dispatched at runtime like
+   the batched kernels above.
+*/
+
+// Smallest and largest of the n values of x, which must be at least one
+// and not NaN
+void vec_min_max(const float * x, size_t n, float & lowest, float & highest);
+
+// Inclusive prefix sum: r[i] = x[0] + ... + x[i].  r may be x.
+void vec_prefix_sum(const uint64_t * x, uint64_t * r, size_t n);
+
+// r[i] = table[indexes[i]]
+void vec_gather(const float * table, const uint32_t * indexes, float * r,
+                size_t n);
+
+// Unpack n values of width bits (up to 64) each from a little endian bit
+// stream, starting at bit firstBit of words.  The stream is numWords
+// words long, and will not be read past that.
+void vec_unpack_bits(const uint64_t * words, size_t numWords,
+                     size_t firstBit, int width, uint64_t * r, size_t n);
+
+// Convert IEEE half precision values to single precision
+void vec_half_to_float(const uint16_t * x, float * r, size_t n);
+
+// Dequantize bytes: r[i] = lowest + scale * x[i]
+void vec_dequantize(const uint8_t * x, float lowest, float scale, float * r,
+                    size_t n);
+
+// Number of bytes at the start of the n of p that can be copied as they
+// are into the value of a JSON string: printable ASCII characters other
+// than '"' and '\\'.  The JSON parser uses it to copy strings a block
+// at a time.
+size_t vec_json_string_run(const char * p, size_t n);
+
+// Number of bytes at the start of the n of p that are JSON whitespace:
+// space, tab, newline or carriage return.
+size_t vec_json_whitespace_run(const char * p, size_t n);
+
 } // namespace Generic
 
 #if MLDB_USE_SSE1
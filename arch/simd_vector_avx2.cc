@@ -0,0 +1,336 @@
+/** simd_vector_avx2.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    SIMD vector operations; AVX2 specializations of the dispatched kernels.
+    This file is compiled with -mavx2 -mfma -mf16c, so must only be called once
+    the cpuid flags have been checked.
+*/
+
+#include "simd_vector_avx2.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <cstring>
+
+namespace MLDB {
+namespace SIMD {
+namespace Avx2 {
+
+namespace {
+
+inline float horiz_sum(__m256 v)
+{
+    __m128 r = _mm_add_ps(_mm256_castps256_ps128(v),
+                          _mm256_extractf128_ps(v, 1));
+    r = _mm_hadd_ps(r, r);
+    r = _mm_hadd_ps(r, r);
+    return _mm_cvtss_f32(r);
+}
+
+/** Dot products of NX vectors of xs with NY vectors of ys, written to
+    r[i * ldr + j].  Each x and y is loaded once per 8 floats and used
+    NY or NX times; 2 x 4 blocks keep the 8 accumulators and 6 loaded
+    values within the 16 ymm registers.  The loops over the block are
+    unrolled explicitly, as otherwise the accumulators are kept in memory.
+*/
+template<int NX, int NY>
+void dotprod_block(const float * const * xs, const float * const * ys,
+                   float * r, size_t ldr, size_t n)
+{
+    __m256 acc[NX][NY];
+    #pragma GCC unroll 8
+    for (int i = 0;  i < NX;  ++i)
+        #pragma GCC unroll 8
+        for (int j = 0;  j < NY;  ++j)
+            acc[i][j] = _mm256_setzero_ps();
+
+    size_t k = 0;
+    for (;  k + 8 <= n;  k += 8) {
+        __m256 y[NY];
+        #pragma GCC unroll 8
+        for (int j = 0;  j < NY;  ++j)
+            y[j] = _mm256_loadu_ps(ys[j] + k);
+        #pragma GCC unroll 8
+        for (int i = 0;  i < NX;  ++i) {
+            __m256 x = _mm256_loadu_ps(xs[i] + k);
+            #pragma GCC unroll 8
+            for (int j = 0;  j < NY;  ++j)
+                acc[i][j] = _mm256_fmadd_ps(x, y[j], acc[i][j]);
+        }
+    }
+
+    #pragma GCC unroll 8
+    for (int i = 0;  i < NX;  ++i) {
+        #pragma GCC unroll 8
+        for (int j = 0;  j < NY;  ++j) {
+            float total = horiz_sum(acc[i][j]);
+            for (size_t kk = k;  kk < n;  ++kk)
+                total += xs[i][kk] * ys[j][kk];
+            r[i * ldr + j] = total;
+        }
+    }
+}
+
+template<int NY>
+void euclid_block(const float * x, const float * const * ys,
+                  float * r, size_t n)
+{
+    __m256 acc[NY];
+    #pragma GCC unroll 8
+    for (int j = 0;  j < NY;  ++j)
+        acc[j] = _mm256_setzero_ps();
+
+    size_t k = 0;
+    for (;  k + 8 <= n;  k += 8) {
+        __m256 xx = _mm256_loadu_ps(x + k);
+        #pragma GCC unroll 8
+        for (int j = 0;  j < NY;  ++j) {
+            __m256 d = _mm256_sub_ps(xx, _mm256_loadu_ps(ys[j] + k));
+            acc[j] = _mm256_fmadd_ps(d, d, acc[j]);
+        }
+    }
+
+    #pragma GCC unroll 8
+    for (int j = 0;  j < NY;  ++j) {
+        float total = horiz_sum(acc[j]);
+        for (size_t kk = k;  kk < n;  ++kk)
+            total += (x[kk] - ys[j][kk]) * (x[kk] - ys[j][kk]);
+        r[j] = total;
+    }
+}
+
+} // file scope
+
+void vec_euclid_many(const float * x, const float * const * ys,
+                     float * r, size_t ny, size_t n)
+{
+    size_t j = 0;
+    for (;  j + 4 <= ny;  j += 4)
+        euclid_block<4>(x, ys + j, r + j, n);
+    for (;  j < ny;  ++j)
+        euclid_block<1>(x, ys + j, r + j, n);
+}
+
+void mat_dotprod(const float * const * xs, size_t nx,
+                 const float * const * ys, size_t ny,
+                 float * r, size_t n)
+{
+    size_t i = 0;
+    for (;  i + 2 <= nx;  i += 2) {
+        size_t j = 0;
+        for (;  j + 4 <= ny;  j += 4)
+            dotprod_block<2, 4>(xs + i, ys + j, r + i * ny + j, ny, n);
+        for (;  j < ny;  ++j)
+            dotprod_block<2, 1>(xs + i, ys + j, r + i * ny + j, ny, n);
+    }
+    for (;  i < nx;  ++i) {
+        size_t j = 0;
+        for (;  j + 4 <= ny;  j += 4)
+            dotprod_block<1, 4>(xs + i, ys + j, r + i * ny + j, ny, n);
+        for (;  j < ny;  ++j)
+            dotprod_block<1, 1>(xs + i, ys + j, r + i * ny + j, ny, n);
+    }
+}
+
+void vec_min_max(const float * x, size_t n, float & lowest, float & highest)
+{
+    size_t i = 0;
+    __m256 mins = _mm256_set1_ps(x[0]), maxs = mins;
+    for (;  i + 8 <= n;  i += 8) {
+        __m256 v = _mm256_loadu_ps(x + i);
+        mins = _mm256_min_ps(mins, v);
+        maxs = _mm256_max_ps(maxs, v);
+    }
+
+    float minv[8], maxv[8];
+    _mm256_storeu_ps(minv, mins);
+    _mm256_storeu_ps(maxv, maxs);
+    float lo = *std::min_element(minv, minv + 8);
+    float hi = *std::max_element(maxv, maxv + 8);
+    for (;  i < n;  ++i) {
+        lo = std::min(lo, x[i]);
+        hi = std::max(hi, x[i]);
+    }
+    lowest = lo;
+    highest = hi;
+}
+
+void vec_gather(const float * table, const uint32_t * indexes, float * r,
+                size_t n)
+{
+    size_t i = 0;
+    for (;  i + 8 <= n;  i += 8) {
+        // Indexes are unsigned, so are widened to 64 bits for the gathers
+        __m128i idx0 = _mm_loadu_si128((const __m128i *)(indexes + i));
+        __m128i idx1 = _mm_loadu_si128((const __m128i *)(indexes + i + 4));
+        __m128 v0 = _mm256_i64gather_ps(table, _mm256_cvtepu32_epi64(idx0), 4);
+        __m128 v1 = _mm256_i64gather_ps(table, _mm256_cvtepu32_epi64(idx1), 4);
+        _mm256_storeu_ps(r + i, _mm256_set_m128(v1, v0));
+    }
+    for (;  i < n;  ++i)
+        r[i] = table[indexes[i]];
+}
+
+void vec_unpack_bits(const uint64_t * words, size_t firstBit, int width,
+                     uint64_t * r, size_t n)
+{
+    const long long * bytes = (const long long *)words;
+    const __m256i mask = _mm256_set1_epi64x((uint64_t(1) << width) - 1);
+    const __m256i seven = _mm256_set1_epi64x(7);
+    const __m256i step = _mm256_set1_epi64x(4 * width);
+    __m256i bits = _mm256_add_epi64(_mm256_set1_epi64x(firstBit),
+                                    _mm256_setr_epi64x(0, width, 2 * width,
+                                                       3 * width));
+    size_t i = 0;
+    for (;  i + 4 <= n;  i += 4) {
+        // Load the 8 bytes from the byte holding the first bit of each
+        // value, then shift off the bits below it
+        __m256i v = _mm256_i64gather_epi64(bytes, _mm256_srli_epi64(bits, 3),
+                                           1);
+        v = _mm256_srlv_epi64(v, _mm256_and_si256(bits, seven));
+        _mm256_storeu_si256((__m256i *)(r + i), _mm256_and_si256(v, mask));
+        bits = _mm256_add_epi64(bits, step);
+    }
+
+    const char * p = (const char *)words;
+    for (;  i < n;  ++i) {
+        size_t bit = firstBit + i * width;
+        uint64_t val;
+        std::memcpy(&val, p + bit / 8, 8);
+        r[i] = (val >> (bit % 8)) & ((uint64_t(1) << width) - 1);
+    }
+}
+
+void vec_prefix_sum(const uint64_t * x, uint64_t * r, size_t n)
+{
+    size_t i = 0;
+    __m256i carry = _mm256_setzero_si256();
+    for (;  i + 4 <= n;  i += 4) {
+        // Two shift and add steps give the sums within the four lanes
+        __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+        __m256i s1 = _mm256_blend_epi32(_mm256_permute4x64_epi64(v, 0x90),
+                                        _mm256_setzero_si256(), 0x03);
+        v = _mm256_add_epi64(v, s1);
+        __m256i s2 = _mm256_blend_epi32(_mm256_permute4x64_epi64(v, 0x40),
+                                        _mm256_setzero_si256(), 0x0f);
+        v = _mm256_add_epi64(_mm256_add_epi64(v, s2), carry);
+        _mm256_storeu_si256((__m256i *)(r + i), v);
+        carry = _mm256_permute4x64_epi64(v, 0xff);
+    }
+
+    uint64_t total = i == 0 ? 0 : r[i - 1];
+    for (;  i < n;  ++i)
+        r[i] = total += x[i];
+}
+
+void vec_half_to_float(const uint16_t * x, float * r, size_t n)
+{
+    size_t i = 0;
+    for (;  i + 8 <= n;  i += 8) {
+        __m128i h = _mm_loadu_si128((const __m128i *)(x + i));
+        _mm256_storeu_ps(r + i, _mm256_cvtph_ps(h));
+    }
+    if (i < n) {
+        uint16_t h[8] = { 0 };
+        float f[8];
+        std::copy(x + i, x + n, h);
+        _mm256_storeu_ps(f, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)h)));
+        std::copy(f, f + (n - i), r + i);
+    }
+}
+
+void vec_dequantize(const uint8_t * x, float lowest, float scale, float * r,
+                    size_t n)
+{
+    size_t i = 0;
+    __m256 lo = _mm256_set1_ps(lowest), sc = _mm256_set1_ps(scale);
+    for (;  i + 8 <= n;  i += 8) {
+        __m128i b = _mm_loadl_epi64((const __m128i *)(x + i));
+        __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(b));
+        _mm256_storeu_ps(r + i, _mm256_fmadd_ps(v, sc, lo));
+    }
+    for (;  i < n;  ++i)
+        r[i] = lowest + scale * x[i];
+}
+
+namespace {
+
+/** Bit i of the result is set if byte i of the 64 at p can't be part of a
+    run of vec_json_string_run().  Bytes from 0x80 are negative, so the
+    signed comparison with the space catches them along with the control
+    characters.
+*/
+inline uint64_t jsonStringSpecialMask(const char * p)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    const __m256i space = _mm256_set1_epi8(' ');
+
+    auto special = [&] (__m256i v) -> uint32_t
+        {
+            __m256i r = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                        _mm256_cmpeq_epi8(v, backslash));
+            r = _mm256_or_si256(r, _mm256_cmpeq_epi8(v, del));
+            r = _mm256_or_si256(r, _mm256_cmpgt_epi8(space, v));
+            return _mm256_movemask_epi8(r);
+        };
+
+    __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+    return special(lo) | (uint64_t(special(hi)) << 32);
+}
+
+/// Bit i of the result is set if byte i of the 64 at p is JSON whitespace
+inline uint64_t jsonWhitespaceMask(const char * p)
+{
+    auto whitespace = [] (__m256i v) -> uint32_t
+        {
+            __m256i r
+                = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                  _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+            r = _mm256_or_si256(r, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+            r = _mm256_or_si256(r, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+            return _mm256_movemask_epi8(r);
+        };
+
+    __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+    return whitespace(lo) | (uint64_t(whitespace(hi)) << 32);
+}
+
+} // file scope
+
+size_t vec_json_string_run(const char * p, size_t n)
+{
+    size_t i = 0;
+    for (;  i + 64 <= n;  i += 64) {
+        uint64_t mask = jsonStringSpecialMask(p + i);
+        if (mask)
+            return i + __builtin_ctzll(mask);
+    }
+
+    // The last partial block is padded with a quote, which ends the run
+    char block[64];
+    std::memset(block, '"', sizeof(block));
+    std::memcpy(block, p + i, n - i);
+    return i + __builtin_ctzll(jsonStringSpecialMask(block));
+}
+
+size_t vec_json_whitespace_run(const char * p, size_t n)
+{
+    size_t i = 0;
+    for (;  i + 64 <= n;  i += 64) {
+        uint64_t mask = ~jsonWhitespaceMask(p + i);
+        if (mask)
+            return i + __builtin_ctzll(mask);
+    }
+
+    char block[64];
+    std::memset(block, 0, sizeof(block));
+    std::memcpy(block, p + i, n - i);
+    return i + __builtin_ctzll(~jsonWhitespaceMask(block));
+}
+
+} // namespace Avx2
+} // namespace SIMD
+} // namespace MLDB
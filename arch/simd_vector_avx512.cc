@@ -0,0 +1,186 @@
+/** simd_vector_avx512.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    SIMD vector operations; AVX-512 specializations of the dispatched kernels.
+    This file is compiled with -mavx512f, so must only be called once the
+    cpuid flags have been checked.
+*/
+
+#include "simd_vector_avx512.h"
+#include <immintrin.h>
+#include <cstring>
+
+namespace MLDB {
+namespace SIMD {
+namespace Avx512 {
+
+namespace {
+
+/// Mask of the floats to load when there are the given number left
+inline __mmask16 tailMask(size_t left)
+{
+    return left >= 16 ? 0xffff : (1 << left) - 1;
+}
+
+/** Dot products of NX vectors of xs with NY vectors of ys, written to
+    r[i * ldr + j].  4 x 4 blocks keep the 16 accumulators and 8 loaded
+    values within the 32 zmm registers.  The last partial group of 16
+    floats uses masked loads, which read zeros past the end.
+
+    The loops over the block are unrolled explicitly, as otherwise the
+    accumulators are kept in memory.
+*/
+template<int NX, int NY>
+void dotprod_block(const float * const * xs, const float * const * ys,
+                   float * r, size_t ldr, size_t n)
+{
+    __m512 acc[NX][NY];
+    #pragma GCC unroll 8
+    for (int i = 0;  i < NX;  ++i)
+        #pragma GCC unroll 8
+        for (int j = 0;  j < NY;  ++j)
+            acc[i][j] = _mm512_setzero_ps();
+
+    for (size_t k = 0;  k < n;  k += 16) {
+        __mmask16 mask = tailMask(n - k);
+        __m512 y[NY];
+        #pragma GCC unroll 8
+        for (int j = 0;  j < NY;  ++j)
+            y[j] = _mm512_maskz_loadu_ps(mask, ys[j] + k);
+        #pragma GCC unroll 8
+        for (int i = 0;  i < NX;  ++i) {
+            __m512 x = _mm512_maskz_loadu_ps(mask, xs[i] + k);
+            #pragma GCC unroll 8
+            for (int j = 0;  j < NY;  ++j)
+                acc[i][j] = _mm512_fmadd_ps(x, y[j], acc[i][j]);
+        }
+    }
+
+    #pragma GCC unroll 8
+    for (int i = 0;  i < NX;  ++i)
+        #pragma GCC unroll 8
+        for (int j = 0;  j < NY;  ++j)
+            r[i * ldr + j] = _mm512_reduce_add_ps(acc[i][j]);
+}
+
+template<int NY>
+void euclid_block(const float * x, const float * const * ys,
+                  float * r, size_t n)
+{
+    __m512 acc[NY];
+    #pragma GCC unroll 8
+    for (int j = 0;  j < NY;  ++j)
+        acc[j] = _mm512_setzero_ps();
+
+    for (size_t k = 0;  k < n;  k += 16) {
+        __mmask16 mask = tailMask(n - k);
+        __m512 xx = _mm512_maskz_loadu_ps(mask, x + k);
+        #pragma GCC unroll 8
+        for (int j = 0;  j < NY;  ++j) {
+            __m512 d = _mm512_sub_ps(xx, _mm512_maskz_loadu_ps
+                                     (mask, ys[j] + k));
+            acc[j] = _mm512_fmadd_ps(d, d, acc[j]);
+        }
+    }
+
+    #pragma GCC unroll 8
+    for (int j = 0;  j < NY;  ++j)
+        r[j] = _mm512_reduce_add_ps(acc[j]);
+}
+
+} // file scope
+
+void vec_euclid_many(const float * x, const float * const * ys,
+                     float * r, size_t ny, size_t n)
+{
+    size_t j = 0;
+    for (;  j + 8 <= ny;  j += 8)
+        euclid_block<8>(x, ys + j, r + j, n);
+    for (;  j < ny;  ++j)
+        euclid_block<1>(x, ys + j, r + j, n);
+}
+
+void mat_dotprod(const float * const * xs, size_t nx,
+                 const float * const * ys, size_t ny,
+                 float * r, size_t n)
+{
+    size_t i = 0;
+    for (;  i + 4 <= nx;  i += 4) {
+        size_t j = 0;
+        for (;  j + 4 <= ny;  j += 4)
+            dotprod_block<4, 4>(xs + i, ys + j, r + i * ny + j, ny, n);
+        for (;  j < ny;  ++j)
+            dotprod_block<4, 1>(xs + i, ys + j, r + i * ny + j, ny, n);
+    }
+    for (;  i < nx;  ++i) {
+        size_t j = 0;
+        for (;  j + 8 <= ny;  j += 8)
+            dotprod_block<1, 8>(xs + i, ys + j, r + i * ny + j, ny, n);
+        for (;  j < ny;  ++j)
+            dotprod_block<1, 1>(xs + i, ys + j, r + i * ny + j, ny, n);
+    }
+}
+
+void vec_min_max(const float * x, size_t n, float & lowest, float & highest)
+{
+    __m512 mins = _mm512_set1_ps(x[0]), maxs = mins;
+    for (size_t i = 0;  i < n;  i += 16) {
+        // Masked off lanes keep x[0], which doesn't change the result
+        __mmask16 m = tailMask(n - i);
+        __m512 v = _mm512_mask_loadu_ps(mins, m, x + i);
+        mins = _mm512_min_ps(mins, v);
+        v = _mm512_mask_loadu_ps(maxs, m, x + i);
+        maxs = _mm512_max_ps(maxs, v);
+    }
+    lowest = _mm512_reduce_min_ps(mins);
+    highest = _mm512_reduce_max_ps(maxs);
+}
+
+void vec_gather(const float * table, const uint32_t * indexes, float * r,
+                size_t n)
+{
+    size_t i = 0;
+    for (;  i + 8 <= n;  i += 8) {
+        // Indexes are unsigned, so are widened to 64 bits for the gather
+        __m256i idx = _mm256_loadu_si256((const __m256i *)(indexes + i));
+        __m256 v = _mm512_i64gather_ps(_mm512_cvtepu32_epi64(idx), table, 4);
+        _mm256_storeu_ps(r + i, v);
+    }
+    for (;  i < n;  ++i)
+        r[i] = table[indexes[i]];
+}
+
+void vec_unpack_bits(const uint64_t * words, size_t firstBit, int width,
+                     uint64_t * r, size_t n)
+{
+    const __m512i mask = _mm512_set1_epi64((uint64_t(1) << width) - 1);
+    const __m512i seven = _mm512_set1_epi64(7);
+    const __m512i step = _mm512_set1_epi64(8 * width);
+    __m512i bits = _mm512_add_epi64(_mm512_set1_epi64(firstBit),
+                                    _mm512_setr_epi64(0, width, 2 * width,
+                                                      3 * width, 4 * width,
+                                                      5 * width, 6 * width,
+                                                      7 * width));
+    size_t i = 0;
+    for (;  i + 8 <= n;  i += 8) {
+        // Load the 8 bytes from the byte holding the first bit of each
+        // value, then shift off the bits below it
+        __m512i v = _mm512_i64gather_epi64(_mm512_srli_epi64(bits, 3),
+                                           words, 1);
+        v = _mm512_srlv_epi64(v, _mm512_and_si512(bits, seven));
+        _mm512_storeu_si512(r + i, _mm512_and_si512(v, mask));
+        bits = _mm512_add_epi64(bits, step);
+    }
+
+    const char * p = (const char *)words;
+    for (;  i < n;  ++i) {
+        size_t bit = firstBit + i * width;
+        uint64_t val;
+        std::memcpy(&val, p + bit / 8, 8);
+        r[i] = (val >> (bit % 8)) & ((uint64_t(1) << width) - 1);
+    }
+}
+
+} // namespace Avx512
+} // namespace SIMD
+} // namespace MLDB
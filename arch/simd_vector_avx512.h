@@ -0,0 +1,41 @@
+/** simd_vector_avx512.h                                           -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    SIMD vector operations; AVX-512 specializations of the dispatched kernels.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace MLDB {
+namespace SIMD {
+namespace Avx512 {
+
+/// Euclidean distance squared from x to each of the ny vectors in ys
+void vec_euclid_many(const float * x, const float * const * ys,
+                     float * r, size_t ny, size_t n);
+
+/// Dot product of each of the nx vectors in xs with each of the ny
+/// vectors in ys, into r[i * ny + j]
+void mat_dotprod(const float * const * xs, size_t nx,
+                 const float * const * ys, size_t ny,
+                 float * r, size_t n);
+
+/// Smallest and largest of the n >= 1 values of x
+void vec_min_max(const float * x, size_t n, float & lowest, float & highest);
+
+/// r[i] = table[indexes[i]]
+void vec_gather(const float * table, const uint32_t * indexes, float * r,
+                size_t n);
+
+/// Unpack n values of width <= 57 bits from the little endian bit stream
+/// at firstBit of words.  All of the 8 bytes at the byte holding the first
+/// bit of each value must be readable.
+void vec_unpack_bits(const uint64_t * words, size_t firstBit, int width,
+                     uint64_t * r, size_t n);
+
+} // namespace Avx512
+} // namespace SIMD
+} // namespace MLDB
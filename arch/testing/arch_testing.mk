@@ -10,8 +10,10 @@ $(eval $(call test,backtrace_test,arch,boost))
 $(eval $(call test,bit_range_ops_test,arch,boost))
 $(eval $(call test,vm_test,arch,boost manual)) # latest linux path make this test fail https://lwn.net/Articles/642074/
 $(eval $(call test,info_test,arch,boost))
+$(eval $(call test,cpu_topology_test,arch,boost))
 $(eval $(call test,rtti_utils_test,arch,boost))
 $(eval $(call test,thread_specific_test,arch,boost))
+$(eval $(call test,profile_scope_test,arch,boost))
 $(eval $(call test,gc_test,gc,boost))
 $(eval $(call test,shared_gc_lock_test,gc,boost manual)) # broken on some environments since gc lock changes
 $(eval $(call test,rcu_protected_test,gc,boost timed))
@@ -0,0 +1,108 @@
+/* cpu_topology_test.cc                                            -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of the discovery of the NUMA topology.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/arch/cpu_info.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/exception_handler.h"
+
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace MLDB;
+
+
+/** Fake sysfs directory for the topology, removed at the end of a test. */
+struct FakeSysfs {
+    FakeSysfs()
+    {
+        char tmpl[] = "/tmp/cpu_topology_test_XXXXXX";
+        BOOST_REQUIRE(mkdtemp(tmpl));
+        dir = tmpl;
+        mkdir((dir + "/cpu").c_str(), 0755);
+    }
+
+    ~FakeSysfs()
+    {
+        int res = system(("rm -rf " + dir).c_str());
+        (void)res;
+    }
+
+    void write(const std::string & path, const std::string & contents)
+    {
+        for (size_t i = path.find('/');  i != std::string::npos;
+             i = path.find('/', i + 1))
+            mkdir((dir + "/" + path.substr(0, i)).c_str(), 0755);
+        std::string full = dir + "/" + path;
+        ofstream stream(full);
+        stream << contents << endl;
+    }
+
+    std::string dir;
+};
+
+BOOST_AUTO_TEST_CASE( test_parse_cpu_list )
+{
+    BOOST_CHECK(parseCpuList("") == vector<int>());
+    BOOST_CHECK(parseCpuList("\n") == vector<int>());
+    BOOST_CHECK(parseCpuList("3") == vector<int>({ 3 }));
+    BOOST_CHECK(parseCpuList("0-3,8,10-11\n")
+                == vector<int>({ 0, 1, 2, 3, 8, 10, 11 }));
+
+    MLDB_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(parseCpuList("3-1"), MLDB::Exception);
+    BOOST_CHECK_THROW(parseCpuList("a"), MLDB::Exception);
+    BOOST_CHECK_THROW(parseCpuList("1;2"), MLDB::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_two_nodes )
+{
+    FakeSysfs sysfs;
+    sysfs.write("cpu/online", "0-5,7");
+    sysfs.write("node/node0/cpulist", "0-2,6");  // 6 is offline
+    sysfs.write("node/node1/cpulist", "3-5,7");
+    sysfs.write("node/node2/cpulist", "");       // memory only
+    sysfs.write("node/online", "0-2");           // not a node
+
+    CpuTopology topology = readCpuTopology(sysfs.dir);
+    BOOST_REQUIRE_EQUAL(topology.numNodes(), 3);
+    BOOST_CHECK(topology.nodeCpus[0] == vector<int>({ 0, 1, 2 }));
+    BOOST_CHECK(topology.nodeCpus[1] == vector<int>({ 3, 4, 5, 7 }));
+    BOOST_CHECK(topology.nodeCpus[2].empty());
+    BOOST_CHECK_EQUAL(topology.nodeOfCpu(4), 1);
+    BOOST_CHECK_EQUAL(topology.cpuNode[6], -1);
+    BOOST_CHECK_EQUAL(topology.nodeOfCpu(6), 0);
+    BOOST_CHECK_EQUAL(topology.nodeOfCpu(100), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_no_numa )
+{
+    FakeSysfs sysfs;
+    sysfs.write("cpu/online", "0-3");
+
+    CpuTopology topology = readCpuTopology(sysfs.dir);
+    BOOST_REQUIRE_EQUAL(topology.numNodes(), 1);
+    BOOST_CHECK(topology.nodeCpus[0] == vector<int>({ 0, 1, 2, 3 }));
+}
+
+BOOST_AUTO_TEST_CASE( test_this_machine )
+{
+    const CpuTopology & topology = cpuTopology();
+    BOOST_REQUIRE_GE(topology.numNodes(), 1);
+    size_t numCpus = 0;
+    for (auto & cpus: topology.nodeCpus)
+        numCpus += cpus.size();
+    BOOST_CHECK_GE(numCpus, 1);
+    int node = currentNumaNode();
+    BOOST_CHECK_GE(node, 0);
+    BOOST_CHECK_LT(node, topology.numNodes());
+}
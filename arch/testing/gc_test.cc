@@ -18,6 +18,8 @@
 #include "mldb/arch/rwlock.h"
 #include "mldb/arch/spinlock.h"
 #include "mldb/arch/tick_counter.h"
+#include "mldb/arch/cpu_info.h"
+#include "mldb/arch/timers.h"
 #include <boost/test/unit_test.hpp>
 #include <iostream>
 #include <atomic>
@@ -356,3 +358,205 @@ BOOST_AUTO_TEST_CASE ( test_defer_race )
 }
 
 #endif
+
+
+/*****************************************************************************/
+/* SHARDED GC LOCK                                                           */
+/*****************************************************************************/
+
+BOOST_AUTO_TEST_CASE ( test_sharded_gc )
+{
+    ShardedGcLock gc;
+
+    gc.lockShared();
+    BOOST_CHECK(gc.isLockedShared());
+    BOOST_CHECK(gc.isLockedByAnyThread());
+
+    std::atomic<int> deferred(false);
+    gc.defer([&] () { deferred = true; });
+
+    // We're still in a critical section, so it can't have run
+    BOOST_CHECK(!deferred);
+
+    gc.unlockShared();
+
+    // The last reader to leave the epoch reclaims the batch
+    BOOST_CHECK(!gc.isLockedShared());
+    BOOST_CHECK(!gc.isLockedByAnyThread());
+    BOOST_CHECK(deferred);
+
+    // Nothing in a critical section, so it's run straight away
+    deferred = false;
+    gc.defer([&] () { deferred = true; });
+    BOOST_CHECK(deferred);
+
+    // Exclusive nests shared sections
+    {
+        GcLock::ExclusiveGuard guard(gc);
+        BOOST_CHECK(gc.isLockedExclusive());
+        GcLock::SharedGuard guard2(gc);
+        BOOST_CHECK(gc.isLockedByAnyThread());
+    }
+    BOOST_CHECK(!gc.isLockedByAnyThread());
+
+    // Work that's still pending when the lock is destroyed is run
+    deferred = false;
+    {
+        ShardedGcLock gc2;
+        gc2.lockShared(0, GcLock::RD_NO);
+        gc2.defer([&] () { deferred = true; });
+        gc2.unlockShared(0, GcLock::RD_NO);
+        BOOST_CHECK(!deferred);
+    }
+    BOOST_CHECK(deferred);
+}
+
+BOOST_AUTO_TEST_CASE ( test_sharded_mutual_exclusion )
+{
+    ShardedGcLock lock;
+    std::atomic<bool> finished(false);
+    std::atomic<int> numExclusive(0);
+    std::atomic<int> numShared(0);
+    std::atomic<int> errors(0);
+    std::atomic<uint64_t> sharedIterations(0);
+    std::atomic<uint64_t> exclusiveIterations(0);
+
+    auto sharedThread = [&] ()
+        {
+            while (!finished) {
+                GcLock::SharedGuard guard(lock);
+                numShared += 1;
+                if (numExclusive > 0) {
+                    cerr << "exclusive and shared" << endl;
+                    errors += 1;
+                }
+                numShared -= 1;
+                sharedIterations += 1;
+            }
+        };
+
+    auto exclusiveThread = [&] ()
+        {
+            while (!finished) {
+                GcLock::ExclusiveGuard guard(lock);
+                numExclusive += 1;
+                if (numExclusive > 1) {
+                    cerr << "more than one exclusive" << endl;
+                    errors += 1;
+                }
+                if (numShared > 0) {
+                    cerr << "exclusive and shared" << endl;
+                    errors += 1;
+                }
+                numExclusive -= 1;
+                exclusiveIterations += 1;
+                std::this_thread::yield();
+            }
+        };
+
+    int nthreads = 4;
+
+    ThreadGroup tg;
+    for (unsigned i = 0;  i < nthreads;  ++i)
+        tg.emplace_back(sharedThread);
+    for (unsigned i = 0;  i < nthreads;  ++i)
+        tg.emplace_back(exclusiveThread);
+    sleep(1);
+    finished = true;
+    tg.join_all();
+
+    cerr << "iterations: shared " << sharedIterations
+         << " exclusive " << exclusiveIterations << endl;
+    BOOST_CHECK_EQUAL(errors, 0);
+    BOOST_CHECK_GT(sharedIterations, 0);
+    BOOST_CHECK_GT(exclusiveIterations, 0);
+}
+
+BOOST_AUTO_TEST_CASE ( test_sharded_gc_sync_many_threads )
+{
+    cerr << "testing synchronized ShardedGcLock with many threads" << endl;
+
+    int nthreads = 8;
+    int nblocks = 2;
+
+    TestBase<ShardedGcLock> test(nthreads, nblocks);
+    test.run(std::bind(&TestBase<ShardedGcLock>::allocThreadSync, &test,
+                       std::placeholders::_1));
+}
+
+BOOST_AUTO_TEST_CASE ( test_sharded_gc_deferred_contention )
+{
+    cerr << "testing contended deferred ShardedGcLock" << endl;
+
+    int nthreads = 8;
+    int nblocks = 2;
+
+    TestBase<ShardedGcLock> test(nthreads, nblocks);
+    test.run(std::bind(&TestBase<ShardedGcLock>::allocThreadDefer, &test,
+                       std::placeholders::_1));
+}
+
+/** Measure how the throughput of short shared critical sections scales with
+    the number of reader threads, for both kinds of reader tracking.  A
+    writer thread swaps a published value and defers its deletion
+    throughout, as an RCU protected structure would.
+*/
+template<typename Lock>
+double benchmarkReaders(int nthreads, double runTime)
+{
+    Lock gc;
+    std::atomic<bool> finished(false);
+    std::atomic<uint64_t> iterations(0);
+    std::atomic<int *> published(new int(0));
+
+    auto readerThread = [&] ()
+        {
+            uint64_t n = 0;
+            while (!finished) {
+                GcLock::SharedGuard guard(gc);
+                ExcAssertGreaterEqual(*published.load(), 0);
+                ++n;
+            }
+            iterations += n;
+        };
+
+    auto writerThread = [&] ()
+        {
+            for (int i = 1;  !finished;  ++i) {
+                int * old = published.exchange(new int(i));
+                gc.deferDelete(old);
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        };
+
+    ThreadGroup tg;
+    Timer timer;
+    for (unsigned i = 0;  i < nthreads;  ++i)
+        tg.emplace_back(readerThread);
+    tg.emplace_back(writerThread);
+    std::this_thread::sleep_for(std::chrono::duration<double>(runTime));
+    finished = true;
+    tg.join_all();
+    double elapsed = timer.elapsed_wall();
+
+    gc.deferBarrier();
+    delete published.load();
+
+    return iterations / elapsed;
+}
+
+BOOST_AUTO_TEST_CASE ( test_gc_reader_scaling )
+{
+    int maxThreads = std::max(4, 2 * num_cpus());
+    double runTime = 0.25;
+
+    cerr << "threads      shared ops/s     sharded ops/s   ratio" << endl;
+    for (int nthreads = 1;  nthreads <= maxThreads;  nthreads *= 2) {
+        double shared = benchmarkReaders<GcLock>(nthreads, runTime);
+        double sharded = benchmarkReaders<ShardedGcLock>(nthreads, runTime);
+        cerr << MLDB::format("%7d %17.0f %17.0f %7.2f\n",
+                             nthreads, shared, sharded, sharded / shared);
+        BOOST_CHECK_GT(shared, 0);
+        BOOST_CHECK_GT(sharded, 0);
+    }
+}
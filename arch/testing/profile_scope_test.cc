@@ -0,0 +1,146 @@
+/* profile_scope_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Tests for the hot path profiler.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/arch/profile_scope.h"
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <chrono>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+static void sleepMs(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static void inner()
+{
+    MLDB_PROFILE_SCOPE("inner");
+    sleepMs(5);
+}
+
+static void outer()
+{
+    MLDB_PROFILE_SCOPE("outer");
+    sleepMs(5);
+    inner();
+    inner();
+}
+
+static int recurse(int depth)
+{
+    MLDB_PROFILE_SCOPE("recurse");
+    return depth == 0 ? 0 : 1 + recurse(depth - 1);
+}
+
+static const ProfileReport::Stack *
+findStack(const ProfileReport & report, const vector<string> & names)
+{
+    for (auto & stack: report.stacks) {
+        if (stack.names == names)
+            return &stack;
+    }
+    return nullptr;
+}
+
+BOOST_AUTO_TEST_CASE( test_off_records_nothing )
+{
+    BOOST_CHECK(!profilingEnabled);
+    outer();
+
+    BOOST_REQUIRE(startProfiling());
+    ProfileReport report = stopProfiling();
+    BOOST_CHECK_EQUAL(report.numThreads, 0);
+    BOOST_CHECK(report.stacks.empty());
+    BOOST_CHECK(report.points.empty());
+
+    // Stopping when not started gives an empty report
+    BOOST_CHECK(stopProfiling().stacks.empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_nested_scopes )
+{
+    BOOST_REQUIRE(startProfiling());
+    BOOST_CHECK(!startProfiling());
+    outer();
+    ProfileReport report = stopProfiling();
+
+    BOOST_CHECK_EQUAL(report.numThreads, 1);
+    BOOST_REQUIRE_EQUAL(report.stacks.size(), 2);
+
+    auto outerStack = findStack(report, { "outer" });
+    auto innerStack = findStack(report, { "outer", "inner" });
+    BOOST_REQUIRE(outerStack);
+    BOOST_REQUIRE(innerStack);
+    BOOST_CHECK_EQUAL(outerStack->count, 1);
+    BOOST_CHECK_EQUAL(innerStack->count, 2);
+    BOOST_CHECK_GE(innerStack->totalSeconds, 0.010);
+    BOOST_CHECK_GE(outerStack->totalSeconds, 0.015);
+    BOOST_CHECK_GE(outerStack->selfSeconds, 0.005);
+    BOOST_CHECK_LT(outerStack->selfSeconds, outerStack->totalSeconds);
+
+    BOOST_REQUIRE_EQUAL(report.points.size(), 2);
+    BOOST_CHECK_EQUAL(report.points[0].name, "outer");
+    BOOST_CHECK_EQUAL(report.points[1].name, "inner");
+    BOOST_CHECK_EQUAL(report.points[1].count, 2);
+
+    string folded = report.folded();
+    BOOST_CHECK(folded.find("outer;inner ") != string::npos);
+    BOOST_CHECK(folded.find("\nouter ") != string::npos
+                || folded.find("outer ") == 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_recursion_is_collapsed )
+{
+    BOOST_REQUIRE(startProfiling());
+    BOOST_CHECK_EQUAL(recurse(100), 100);
+    ProfileReport report = stopProfiling();
+
+    BOOST_REQUIRE_EQUAL(report.stacks.size(), 1);
+    BOOST_CHECK(report.stacks[0].names == vector<string>({ "recurse" }));
+    BOOST_CHECK_EQUAL(report.stacks[0].count, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_threads_and_sessions )
+{
+    BOOST_REQUIRE(startProfiling());
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < 4;  ++i)
+        threads.emplace_back(inner);
+    for (auto & t: threads)
+        t.join();
+    ProfileReport report = stopProfiling();
+
+    BOOST_CHECK_EQUAL(report.numThreads, 4);
+    auto innerStack = findStack(report, { "inner" });
+    BOOST_REQUIRE(innerStack);
+    BOOST_CHECK_EQUAL(innerStack->count, 4);
+
+    // A scope that's open when a session starts isn't recorded, and doesn't
+    // disturb the stacks of the new session
+    {
+        MLDB_PROFILE_SCOPE("open");
+        BOOST_REQUIRE(startProfiling());
+        MLDB_PROFILE_SCOPE("before");
+        report = stopProfiling();
+        BOOST_REQUIRE(startProfiling());
+        inner();
+    }
+    inner();
+    report = stopProfiling();
+
+    innerStack = findStack(report, { "inner" });
+    BOOST_REQUIRE(innerStack);
+    BOOST_CHECK_EQUAL(innerStack->count, 2);
+    BOOST_CHECK_EQUAL(report.stacks.size(), 1);
+}
@@ -93,3 +93,44 @@ BOOST_AUTO_TEST_CASE( benchmark )
              << endl;
     }
 }
+
+BOOST_AUTO_TEST_CASE( benchmark_batch )
+{
+    // 64 queries against 4096 rows, as in a block of a nearest neighbours
+    // scan
+    size_t nx = 64, ny = 4096;
+
+    for (int nvals: { 16, 64, 256, 1024 }) {
+        vector<float> x(nx * nvals), y(ny * nvals), r(nx * ny);
+        vector<const float *> xs, ys;
+
+        for (auto & f: x)
+            f = rand() / 16384.0;
+        for (auto & f: y)
+            f = rand() / 16384.0;
+        for (size_t i = 0;  i < nx;  ++i)
+            xs.push_back(&x[i * nvals]);
+        for (size_t j = 0;  j < ny;  ++j)
+            ys.push_back(&y[j * nvals]);
+
+        double minBatch = INFINITY, minPairwise = INFINITY;
+
+        for (unsigned iter = 0;  iter < 10;  ++iter) {
+            uint64_t t0 = ticks();
+            SIMD::mat_dotprod(xs.data(), nx, ys.data(), ny, r.data(), nvals);
+            uint64_t t1 = ticks();
+            for (size_t i = 0;  i < nx;  ++i)
+                for (size_t j = 0;  j < ny;  ++j)
+                    r[i * ny + j] = SIMD::vec_dotprod(xs[i], ys[j], nvals);
+            uint64_t t2 = ticks();
+
+            minBatch = std::min<double>(minBatch, t1 - t0);
+            minPairwise = std::min<double>(minPairwise, t2 - t1);
+        }
+
+        double ops = (double)nx * ny * nvals;
+        cerr << "nvals = " << nvals << " cycles/op: batch " << minBatch / ops
+             << " pairwise " << minPairwise / ops
+             << " speedup " << minPairwise / minBatch << endl;
+    }
+}
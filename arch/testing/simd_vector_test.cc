@@ -14,6 +14,10 @@
 #include "mldb/arch/simd_vector.h"
 #include "mldb/arch/demangle.h"
 #include "mldb/arch/simd.h"
+#if MLDB_INTEL_ISA
+# include "mldb/arch/simd_vector_avx2.h"
+# include "mldb/arch/simd_vector_avx512.h"
+#endif
 
 #include <boost/test/unit_test.hpp>
 #include <boost/test/floating_point_comparison.hpp>
@@ -21,6 +25,7 @@
 #include <set>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 
 
 using namespace MLDB;
@@ -896,3 +901,263 @@ BOOST_AUTO_TEST_CASE( vec_min_max_el_test )
     }
 }
 
+
+
+typedef void (*MatDotprod) (const float * const *, size_t,
+                            const float * const *, size_t, float *, size_t);
+typedef void (*VecEuclidMany) (const float *, const float * const *,
+                               float *, size_t, size_t);
+
+void batch_kernels_test_case(const std::string & isa,
+                             MatDotprod matDotprod,
+                             VecEuclidMany vecEuclidMany,
+                             int nx, int ny, int nvals)
+{
+    cerr << "testing " << isa << " batch kernels with " << nx << "x"
+         << ny << "x" << nvals << endl;
+
+    vector<vector<float> > x(nx, vector<float>(nvals));
+    vector<vector<float> > y(ny, vector<float>(nvals));
+    vector<const float *> xs, ys;
+
+    for (auto & v: x) {
+        for (auto & f: v)
+            f = rand() / float(RAND_MAX) - 0.5;
+        xs.push_back(v.data());
+    }
+    for (auto & v: y) {
+        for (auto & f: v)
+            f = rand() / float(RAND_MAX) - 0.5;
+        ys.push_back(v.data());
+    }
+
+    vector<float> r(nx * ny);
+    matDotprod(xs.data(), nx, ys.data(), ny, r.data(), nvals);
+
+    for (unsigned i = 0;  i < nx;  ++i) {
+        for (unsigned j = 0;  j < ny;  ++j) {
+            double expected = 0.0;
+            for (unsigned k = 0;  k < nvals;  ++k)
+                expected += x[i][k] * y[j][k];
+            BOOST_CHECK_SMALL(r[i * ny + j] - expected, 1e-4 * (nvals + 1));
+        }
+    }
+
+    vector<float> d(ny);
+    vecEuclidMany(xs[0], ys.data(), d.data(), ny, nvals);
+
+    for (unsigned j = 0;  j < ny;  ++j) {
+        double expected = 0.0;
+        for (unsigned k = 0;  k < nvals;  ++k)
+            expected += (x[0][k] - y[j][k]) * (x[0][k] - y[j][k]);
+        BOOST_CHECK_SMALL(d[j] - expected, 1e-4 * (nvals + 1));
+    }
+}
+
+void batch_kernels_test(const std::string & isa,
+                        MatDotprod matDotprod,
+                        VecEuclidMany vecEuclidMany)
+{
+    // Cover the register blocks and their remainders, and vectors both
+    // shorter and longer than a simd register
+    for (int nx: { 1, 2, 3, 5, 9 }) {
+        for (int ny: { 1, 4, 7, 17 }) {
+            for (int nvals: { 1, 7, 8, 15, 16, 17, 64, 100 }) {
+                batch_kernels_test_case(isa, matDotprod, vecEuclidMany,
+                                        nx, ny, nvals);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( batch_kernels_test_dispatched )
+{
+    batch_kernels_test("dispatched", SIMD::mat_dotprod, SIMD::vec_euclid_many);
+
+    // The one query version is the same as the first row of the matrix
+    float x[3] = { 1, 2, 3 }, y[3] = { 4, 5, 6 };
+    const float * ys[2] = { x, y };
+    float r[2];
+    SIMD::vec_dotprod_many(x, ys, r, 2, 3);
+    BOOST_CHECK_EQUAL(r[0], 14);
+    BOOST_CHECK_EQUAL(r[1], 32);
+}
+
+#if MLDB_INTEL_ISA
+BOOST_AUTO_TEST_CASE( batch_kernels_test_isa )
+{
+    if (has_avx() && has_avx2() && has_fma()) {
+        batch_kernels_test("avx2", SIMD::Avx2::mat_dotprod,
+                           SIMD::Avx2::vec_euclid_many);
+    }
+    if (has_avx512f()) {
+        batch_kernels_test("avx512", SIMD::Avx512::mat_dotprod,
+                           SIMD::Avx512::vec_euclid_many);
+    }
+}
+#endif
+
+/** Run the test function once for each instruction set the CPU supports,
+    with the dispatched kernels using it.
+*/
+template<typename Fn>
+void forEachSupportedIsa(Fn && fn)
+{
+    SIMD::Isa best = SIMD::bestSupportedIsa();
+    SIMD::Isa before = SIMD::simdIsa();
+    for (SIMD::Isa isa: { SIMD::Isa::GENERIC, SIMD::Isa::AVX2,
+                          SIMD::Isa::AVX512 }) {
+        if (isa > best)
+            break;
+        BOOST_TEST_CHECKPOINT("isa " << SIMD::isaName(isa));
+        SIMD::setSimdIsa(isa);
+        fn(SIMD::isaName(isa));
+    }
+    SIMD::setSimdIsa(before);
+}
+
+BOOST_AUTO_TEST_CASE( simd_isa_test )
+{
+    BOOST_CHECK(SIMD::simdIsa() <= SIMD::bestSupportedIsa());
+    BOOST_CHECK_EQUAL(SIMD::isaName(SIMD::Isa::AVX2), string("avx2"));
+    if (SIMD::bestSupportedIsa() != SIMD::Isa::AVX512) {
+        BOOST_CHECK_THROW(SIMD::setSimdIsa(SIMD::Isa::AVX512),
+                          std::exception);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( vec_min_max_test )
+{
+    forEachSupportedIsa([] (const char * isa)
+    {
+        for (size_t n: { 1, 7, 8, 15, 16, 17, 100 }) {
+            vector<float> x(n);
+            for (auto & f: x)
+                f = rand() / float(RAND_MAX) - 0.5;
+            float lowest, highest;
+            SIMD::vec_min_max(x.data(), n, lowest, highest);
+            BOOST_CHECK_EQUAL(lowest, *std::min_element(x.begin(), x.end()));
+            BOOST_CHECK_EQUAL(highest, *std::max_element(x.begin(), x.end()));
+        }
+    });
+}
+
+BOOST_AUTO_TEST_CASE( vec_prefix_sum_test )
+{
+    forEachSupportedIsa([] (const char * isa)
+    {
+        for (size_t n: { 0, 1, 3, 4, 5, 8, 13, 100 }) {
+            vector<uint64_t> x(n), r(n);
+            for (auto & v: x)
+                v = rand();
+            SIMD::vec_prefix_sum(x.data(), r.data(), n);
+            uint64_t total = 0;
+            for (size_t i = 0;  i < n;  ++i) {
+                total += x[i];
+                BOOST_CHECK_EQUAL(r[i], total);
+            }
+
+            // In place
+            SIMD::vec_prefix_sum(x.data(), x.data(), n);
+            BOOST_CHECK(x == r);
+        }
+    });
+}
+
+BOOST_AUTO_TEST_CASE( vec_gather_test )
+{
+    forEachSupportedIsa([] (const char * isa)
+    {
+        vector<float> table(1000);
+        for (size_t i = 0;  i < table.size();  ++i)
+            table[i] = i * 0.5;
+        for (size_t n: { 0, 1, 7, 8, 9, 33 }) {
+            vector<uint32_t> indexes(n);
+            for (auto & i: indexes)
+                i = rand() % table.size();
+            vector<float> r(n);
+            SIMD::vec_gather(table.data(), indexes.data(), r.data(), n);
+            for (size_t i = 0;  i < n;  ++i)
+                BOOST_CHECK_EQUAL(r[i], table[indexes[i]]);
+        }
+    });
+}
+
+BOOST_AUTO_TEST_CASE( vec_unpack_bits_test )
+{
+    forEachSupportedIsa([] (const char * isa)
+    {
+        for (int width: { 0, 1, 3, 8, 13, 32, 57, 58, 63, 64 }) {
+            for (size_t firstBit: { 0, 5, 64, 71 }) {
+                // The stream ends just after the last value, so that the
+                // values near the end can't be read with a full load
+                size_t n = 37;
+                size_t numWords = (firstBit + n * width + 63) / 64;
+                vector<uint64_t> words(numWords);
+                for (auto & w: words)
+                    w = (uint64_t(rand()) << 32) ^ rand();
+
+                vector<uint64_t> r(n);
+                SIMD::vec_unpack_bits(words.data(), numWords, firstBit, width,
+                                      r.data(), n);
+
+                for (size_t i = 0;  i < n;  ++i) {
+                    uint64_t expected = 0;
+                    for (int b = 0;  b < width;  ++b) {
+                        size_t bit = firstBit + i * width + b;
+                        expected |= ((words[bit / 64] >> (bit % 64)) & 1) << b;
+                    }
+                    BOOST_CHECK_EQUAL(r[i], expected);
+                }
+            }
+        }
+    });
+}
+
+BOOST_AUTO_TEST_CASE( vec_half_to_float_test )
+{
+    forEachSupportedIsa([] (const char * isa)
+    {
+        // 1.0, -2.0, 65504 (largest), smallest subnormal, 0, -0, inf
+        vector<uint16_t> x = { 0x3c00, 0xc000, 0x7bff, 0x0001, 0x0000,
+                               0x8000, 0x7c00, 0x3555, 0x3800 };
+        vector<float> expected = { 1.0, -2.0, 65504.0, std::ldexp(1.0f, -24),
+                                   0.0, -0.0, INFINITY,
+                                   0.333251953125, 0.5 };
+        vector<float> r(x.size());
+        SIMD::vec_half_to_float(x.data(), r.data(), x.size());
+        for (size_t i = 0;  i < x.size();  ++i) {
+            BOOST_CHECK_EQUAL(r[i], expected[i]);
+            BOOST_CHECK_EQUAL(std::signbit(r[i]), std::signbit(expected[i]));
+        }
+
+        // Every value that isn't a NaN
+        vector<uint16_t> all;
+        for (unsigned h = 0;  h < 65536;  ++h) {
+            if ((h & 0x7c00) != 0x7c00 || (h & 0x3ff) == 0)
+                all.push_back(h);
+        }
+        vector<float> allR(all.size());
+        SIMD::vec_half_to_float(all.data(), allR.data(), all.size());
+        SIMD::setSimdIsa(SIMD::Isa::GENERIC);
+        vector<float> allExpected(all.size());
+        SIMD::vec_half_to_float(all.data(), allExpected.data(), all.size());
+        BOOST_CHECK(allR == allExpected);
+    });
+}
+
+BOOST_AUTO_TEST_CASE( vec_dequantize_test )
+{
+    forEachSupportedIsa([] (const char * isa)
+    {
+        for (size_t n: { 0, 1, 7, 8, 9, 100 }) {
+            vector<uint8_t> x(n);
+            for (size_t i = 0;  i < n;  ++i)
+                x[i] = i * 37;
+            vector<float> r(n);
+            SIMD::vec_dequantize(x.data(), -1.5, 0.01, r.data(), n);
+            for (size_t i = 0;  i < n;  ++i)
+                BOOST_CHECK_SMALL(r[i] - (-1.5f + 0.01f * x[i]), 1e-5f);
+        }
+    });
+}
@@ -5,6 +5,8 @@ LIBBASE_SOURCES := \
         parse_context.cc \
 	thread_pool.cc \
 	parallel.cc \
+	memory_arena.cc \
+	resource_usage.cc \
 	optimized_path.cc \
 	hex_dump.cc \
 
@@ -17,8 +17,44 @@ using namespace std;
 
 namespace MLDB {
 
+/** Fast path for the functions below, for when the whole integer is in the
+    current buffer of c: it's parsed directly from there, with no token and
+    without going through c for each character.  Returns false, having done
+    nothing, if there are no digits or if they may go on into the next
+    buffer; the usual path is then taken.  Like the usual path, the value
+    wraps around on overflow.
+*/
+template<typename Int, typename UInt>
+inline bool match_integer_in_buffer(Int & result, ParseContext & c,
+                                    bool allowSign)
+{
+    const char * start = c.get_buffer_pos(), * end = c.get_buffer_end();
+    const char * p = start;
+
+    bool negative = false;
+    if (allowSign && p != end && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    const char * digits = p;
+    UInt mag = 0;
+    for (;  p != end && *p >= '0' && *p <= '9';  ++p)
+        mag = mag * 10 + (*p - '0');
+
+    if (p == digits || p == end)
+        return false;
+
+    result = negative ? Int(UInt(0) - mag) : Int(mag);
+    c.advance_in_buffer(p - start);
+    return true;
+}
+
 inline bool match_unsigned(unsigned long & val, ParseContext & c)
 {
+    if (match_integer_in_buffer<unsigned long, unsigned long>(val, c, false))
+        return true;
+
     ParseContext::Revert_Token tok(c);
 
     val = 0;
@@ -44,6 +80,9 @@ inline bool match_unsigned(unsigned long & val, ParseContext & c)
 
 inline bool match_int(long int & result, ParseContext & c)
 {
+    if (match_integer_in_buffer<long, unsigned long>(result, c, true))
+        return true;
+
     ParseContext::Revert_Token tok(c);
 
     int sign = 1;
@@ -100,6 +139,9 @@ inline bool match_hex4(long int & result, ParseContext & c)
 inline bool match_unsigned_long(unsigned long & val,
                                 ParseContext & c)
 {
+    if (match_integer_in_buffer<unsigned long, unsigned long>(val, c, false))
+        return true;
+
     ParseContext::Revert_Token tok(c);
 
     val = 0;
@@ -125,6 +167,9 @@ inline bool match_unsigned_long(unsigned long & val,
 
 inline bool match_long(long int & result, ParseContext & c)
 {
+    if (match_integer_in_buffer<long, unsigned long>(result, c, true))
+        return true;
+
     ParseContext::Revert_Token tok(c);
 
     long sign = 1;
@@ -145,6 +190,10 @@ inline bool match_long(long int & result, ParseContext & c)
 inline bool match_unsigned_long_long(unsigned long long & val,
                                      ParseContext & c)
 {
+    if (match_integer_in_buffer<unsigned long long, unsigned long long>
+            (val, c, false))
+        return true;
+
     ParseContext::Revert_Token tok(c);
 
     val = 0;
@@ -170,6 +219,10 @@ inline bool match_unsigned_long_long(unsigned long long & val,
 
 inline bool match_long_long(long long int & result, ParseContext & c)
 {
+    if (match_integer_in_buffer<long long, unsigned long long>
+            (result, c, true))
+        return true;
+
     ParseContext::Revert_Token tok(c);
 
     long long sign = 1;
@@ -0,0 +1,254 @@
+/** memory_arena.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Implementation of memory arenas.
+*/
+
+#include "mldb/base/memory_arena.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/bitops.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+
+namespace MLDB {
+
+namespace {
+
+static __thread MemoryArena * currentArena = nullptr;
+
+size_t pageSize()
+{
+    static const size_t result = sysconf(_SC_PAGESIZE);
+    return result;
+}
+
+size_t roundToPages(size_t bytes)
+{
+    return (bytes + pageSize() - 1) & ~(pageSize() - 1);
+}
+
+void * mapMemory(size_t bytes)
+{
+    void * result = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED)
+        throw std::bad_alloc();
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* MEMORY ARENA                                                              */
+/*****************************************************************************/
+
+struct MemoryArena::Itl {
+    Itl(std::string name, size_t blockSize)
+        : name(std::move(name)), blockSize(roundToPages(blockSize))
+    {
+        ExcAssertGreaterEqual(this->blockSize, MAX_SLAB_SIZE);
+        std::fill(freeLists, freeLists + NUM_CLASSES, nullptr);
+    }
+
+    ~Itl()
+    {
+        for (auto & b: blocks)
+            munmap(b, blockSize);
+        for (auto & l: large)
+            munmap(l.first, l.second);
+    }
+
+    /// Slab allocations are aligned to their size, up to this
+    static constexpr size_t MAX_SLAB_ALIGNMENT = 64;
+
+    /// Size classes are the powers of two from 16 to MAX_SLAB_SIZE
+    static constexpr int MIN_CLASS_BITS = 4;
+    static constexpr int NUM_CLASSES = 12;
+    static_assert((16 << (NUM_CLASSES - 1)) == MAX_SLAB_SIZE,
+                  "size classes must go up to the maximum slab size");
+
+    static int sizeClass(size_t bytes)
+    {
+        if (bytes <= (1 << MIN_CLASS_BITS))
+            return 0;
+        return highest_bit(bytes - 1) + 1 - MIN_CLASS_BITS;
+    }
+
+    struct FreeEntry {
+        FreeEntry * next;
+    };
+
+    std::string name;
+    size_t blockSize;
+
+    mutable std::mutex mutex;
+    FreeEntry * freeLists[NUM_CLASSES];
+    std::vector<void *> blocks;
+    char * current = nullptr;     ///< Next free byte of the last block
+    char * currentEnd = nullptr;  ///< End of the last block
+    std::unordered_map<void *, size_t> large;  ///< Pointer to mapped size
+    MemoryArenaStats stats;
+
+    void addReserved(size_t bytes)
+    {
+        stats.bytesReserved += bytes;
+        stats.peakBytesReserved
+            = std::max(stats.peakBytesReserved, stats.bytesReserved);
+    }
+
+    void * allocateSlab(int cls)
+    {
+        if (freeLists[cls]) {
+            FreeEntry * result = freeLists[cls];
+            freeLists[cls] = result->next;
+            return result;
+        }
+
+        size_t size = size_t(1) << (cls + MIN_CLASS_BITS);
+        size_t alignment = std::min(size, MAX_SLAB_ALIGNMENT);
+        char * start = (char *)(((size_t)current + alignment - 1)
+                                & ~(alignment - 1));
+        if (!current || start + size > currentEnd) {
+            // Whatever is left of the last block is lost until the arena
+            // is destroyed; it's less than MAX_SLAB_SIZE per block
+            current = (char *)mapMemory(blockSize);
+            currentEnd = current + blockSize;
+            blocks.push_back(current);
+            addReserved(blockSize);
+            start = current;
+        }
+        current = start + size;
+        return start;
+    }
+};
+
+MemoryArena::
+MemoryArena(std::string name, size_t blockSize)
+    : itl(new Itl(std::move(name), blockSize))
+{
+}
+
+MemoryArena::
+~MemoryArena()
+{
+}
+
+const std::string &
+MemoryArena::
+name() const
+{
+    return itl->name;
+}
+
+MemoryArenaStats
+MemoryArena::
+stats() const
+{
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    return itl->stats;
+}
+
+MemoryArena *
+MemoryArena::
+current()
+{
+    return currentArena;
+}
+
+std::pmr::memory_resource *
+MemoryArena::
+currentResource()
+{
+    if (currentArena)
+        return currentArena;
+    return std::pmr::new_delete_resource();
+}
+
+void *
+MemoryArena::
+do_allocate(size_t bytes, size_t alignment)
+{
+    if (bytes == 0)
+        bytes = 1;
+
+    std::unique_lock<std::mutex> guard(itl->mutex);
+
+    void * result;
+    if (bytes <= MAX_SLAB_SIZE && alignment <= Itl::MAX_SLAB_ALIGNMENT) {
+        result = itl->allocateSlab(Itl::sizeClass(bytes));
+    }
+    else {
+        if (alignment > pageSize())
+            throw std::bad_alloc();
+        size_t mapped = roundToPages(bytes);
+        result = mapMemory(mapped);
+        itl->large[result] = mapped;
+        itl->addReserved(mapped);
+    }
+
+    itl->stats.bytesInUse += bytes;
+    itl->stats.peakBytesInUse
+        = std::max(itl->stats.peakBytesInUse, itl->stats.bytesInUse);
+    itl->stats.numAllocations += 1;
+    itl->stats.bytesAllocated += bytes;
+    return result;
+}
+
+void
+MemoryArena::
+do_deallocate(void * p, size_t bytes, size_t alignment)
+{
+    if (bytes == 0)
+        bytes = 1;
+
+    std::unique_lock<std::mutex> guard(itl->mutex);
+
+    itl->stats.bytesInUse -= bytes;
+
+    if (bytes <= MAX_SLAB_SIZE && alignment <= Itl::MAX_SLAB_ALIGNMENT) {
+        int cls = Itl::sizeClass(bytes);
+        auto entry = reinterpret_cast<Itl::FreeEntry *>(p);
+        entry->next = itl->freeLists[cls];
+        itl->freeLists[cls] = entry;
+        return;
+    }
+
+    auto it = itl->large.find(p);
+    ExcAssert(it != itl->large.end());
+    munmap(p, it->second);
+    itl->stats.bytesReserved -= it->second;
+    itl->large.erase(it);
+}
+
+bool
+MemoryArena::
+do_is_equal(const std::pmr::memory_resource & other) const noexcept
+{
+    return this == &other;
+}
+
+
+/*****************************************************************************/
+/* MEMORY ARENA SCOPE                                                        */
+/*****************************************************************************/
+
+MemoryArenaScope::
+MemoryArenaScope(MemoryArena * arena)
+    : previous(currentArena)
+{
+    currentArena = arena;
+}
+
+MemoryArenaScope::
+~MemoryArenaScope()
+{
+    currentArena = previous;
+}
+
+} // namespace MLDB
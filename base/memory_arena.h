@@ -0,0 +1,103 @@
+/** memory_arena.h                                                 -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Arena of memory that the temporary allocations of a procedure run or a
+    query can be scoped to, so that it can all be given back to the OS at
+    once when the work is done.
+*/
+
+#pragma once
+
+#include <memory_resource>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* MEMORY ARENA                                                              */
+/*****************************************************************************/
+
+/** Accounting of the memory of an arena. */
+struct MemoryArenaStats {
+    uint64_t bytesInUse = 0;         ///< Allocated and not yet deallocated
+    uint64_t peakBytesInUse = 0;     ///< Highest value of bytesInUse
+    uint64_t bytesReserved = 0;      ///< Currently obtained from the OS
+    uint64_t peakBytesReserved = 0;  ///< Highest value of bytesReserved
+    uint64_t numAllocations = 0;     ///< Over the life of the arena
+    uint64_t bytesAllocated = 0;     ///< Over the life of the arena
+};
+
+/** A memory resource that carves its allocations out of memory that it
+    maps directly from the OS, and unmaps it all when it is destroyed.
+    Unlike the global allocator, whose heap fragments and whose RSS
+    doesn't shrink after a big job, everything used by an arena is
+    returned once its work is finished.
+
+    Allocations of up to MAX_SLAB_SIZE bytes are rounded up to a power of
+    two and taken from slabs of blocks of blockSize bytes; deallocating one
+    puts it on the free list of its size, to be reused by the next one.
+    Larger allocations are mapped on their own and unmapped as soon as they
+    are deallocated.
+
+    An arena may be used from several threads at once.  It is a
+    std::pmr::memory_resource, so that standard containers can use it with
+    std::pmr::polymorphic_allocator.
+*/
+struct MemoryArena: public std::pmr::memory_resource {
+    MemoryArena(std::string name = "", size_t blockSize = 1 << 20);
+    ~MemoryArena();
+
+    MemoryArena(const MemoryArena &) = delete;
+    void operator = (const MemoryArena &) = delete;
+
+    static constexpr size_t MAX_SLAB_SIZE = 32768;
+
+    const std::string & name() const;
+
+    MemoryArenaStats stats() const;
+
+    /** Arena of the innermost MemoryArenaScope on this thread, or of the
+        thread that started the parallelMap() job it is running.  Null if
+        there is none.
+    */
+    static MemoryArena * current();
+
+    /** Memory resource that temporary allocations should use: the current
+        arena if there is one, or otherwise the global allocator.
+    */
+    static std::pmr::memory_resource * currentResource();
+
+private:
+    void * do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void * p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource & other)
+        const noexcept override;
+
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+
+/*****************************************************************************/
+/* MEMORY ARENA SCOPE                                                        */
+/*****************************************************************************/
+
+/** While in scope, makes the given arena (which may be null for none)
+    the current one for this thread and for the helper threads of the
+    parallelMap() calls made within it.
+*/
+struct MemoryArenaScope {
+    MemoryArenaScope(MemoryArena * arena);
+    ~MemoryArenaScope();
+
+    MemoryArenaScope(const MemoryArenaScope &) = delete;
+    void operator = (const MemoryArenaScope &) = delete;
+
+private:
+    MemoryArena * previous;
+};
+
+} // namespace MLDB
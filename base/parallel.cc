@@ -8,13 +8,282 @@
 #include "parallel.h"
 #include "mldb/compiler/compiler.h"
 #include "mldb/base/exc_assert.h"
+#include "mldb/arch/cpu_info.h"
 #include "thread_pool.h"
+#include "memory_arena.h"
+#include "resource_usage.h"
 #include <atomic>
 #include <mutex>
+#include <cstdlib>
+#include <vector>
 
 namespace MLDB {
 
 
+/*****************************************************************************/
+/* PARALLELISM SCOPE                                                         */
+/*****************************************************************************/
+
+struct ParallelismScope::State {
+    State(int maxParallelism, ParallelPriority priority, State * parent)
+        : maxParallelism(maxParallelism), priority(priority), parent(parent),
+          helpers(0)
+    {
+        if (parent && parent->maxParallelism != -1
+            && (this->maxParallelism == -1
+                || parent->maxParallelism < this->maxParallelism))
+            this->maxParallelism = parent->maxParallelism;
+    }
+
+    /// Tightest limit of this and the enclosing scopes, or -1
+    int maxParallelism;
+    ParallelPriority priority;
+
+    /// Enclosing scope, whose limit our helper threads also count against
+    State * parent;
+
+    /// Number of helper threads currently working for the scope
+    std::atomic<int> helpers;
+
+    /// Reserve a helper thread in this and all enclosing scopes, returning
+    /// false if one of their limits would be exceeded
+    bool acquire()
+    {
+        int current = helpers.load();
+        do {
+            if (maxParallelism != -1 && current >= maxParallelism - 1)
+                return false;
+        } while (!helpers.compare_exchange_weak(current, current + 1));
+
+        if (parent && !parent->acquire()) {
+            --helpers;
+            return false;
+        }
+        return true;
+    }
+
+    void release()
+    {
+        for (State * s = this;  s;  s = s->parent)
+            --s->helpers;
+    }
+};
+
+namespace {
+
+static __thread ParallelismScope::State * currentState = nullptr;
+
+std::atomic<int> numInteractiveScopes(0);
+std::atomic<int> numBatchHelpers(0);
+
+std::atomic<int> & batchShare()
+{
+    static std::atomic<int> result([] ()
+        {
+            const char * env = getenv("MLDB_BATCH_THREAD_SHARE");
+            if (env && atoi(env) > 0)
+                return atoi(env);
+            return std::max(1, numCpus() / 2);
+        }());
+    return result;
+}
+
+/** Reserve a helper thread for batch work, returning false if batch work
+    has used up its share of the CPUs while interactive work is running.
+*/
+bool acquireBatchHelper()
+{
+    if (numInteractiveScopes.load(std::memory_order_relaxed) > 0
+        && numBatchHelpers.load(std::memory_order_relaxed)
+           >= batchShare().load(std::memory_order_relaxed))
+        return false;
+    ++numBatchHelpers;
+    return true;
+}
+
+/// Returns true if a batch helper thread should retire to make space for
+/// interactive work
+bool batchShouldYield()
+{
+    return numInteractiveScopes.load(std::memory_order_relaxed) > 0
+        && numBatchHelpers.load(std::memory_order_relaxed)
+           > batchShare().load(std::memory_order_relaxed);
+}
+
+/// Makes the scope of the thread that started a parallel job current on
+/// the helper thread running part of it
+struct AdoptParallelismScope {
+    AdoptParallelismScope(ParallelismScope::State * state)
+        : previous(currentState)
+    {
+        currentState = state;
+    }
+
+    ~AdoptParallelismScope()
+    {
+        currentState = previous;
+    }
+
+    ParallelismScope::State * previous;
+};
+
+} // file scope
+
+ParallelismScope::
+ParallelismScope(int maxParallelism, ParallelPriority priority)
+    : previous(currentState)
+{
+    ExcAssert(maxParallelism == -1 || maxParallelism > 0);
+    state = std::make_shared<State>(maxParallelism, priority, currentState);
+    if (priority == ParallelPriority::INTERACTIVE)
+        ++numInteractiveScopes;
+    currentState = state.get();
+}
+
+ParallelismScope::
+~ParallelismScope()
+{
+    if (state->priority == ParallelPriority::INTERACTIVE)
+        --numInteractiveScopes;
+    currentState = previous;
+}
+
+int
+ParallelismScope::
+maxParallelism()
+{
+    return currentState ? currentState->maxParallelism : -1;
+}
+
+int
+ParallelismScope::
+limit(int numThreads)
+{
+    if (numThreads == -1)
+        numThreads = numCpus();
+    int result = maxParallelism();
+    if (result == -1 || numThreads < result)
+        return numThreads;
+    return result;
+}
+
+ParallelPriority
+ParallelismScope::
+priority()
+{
+    return currentState ? currentState->priority
+        : ParallelPriority::INTERACTIVE;
+}
+
+int
+ParallelismScope::
+numInteractive()
+{
+    return numInteractiveScopes;
+}
+
+int
+ParallelismScope::
+batchThreadShare()
+{
+    return batchShare();
+}
+
+void
+ParallelismScope::
+setBatchThreadShare(int numThreads)
+{
+    ExcAssertGreater(numThreads, 0);
+    batchShare() = numThreads;
+}
+
+
+/*****************************************************************************/
+/* PARALLEL MAP                                                              */
+/*****************************************************************************/
+
+/** Run doOne() repeatedly over up to occupancyLimit threads, including
+    this one, until it returns false, respecting the limits and priority
+    of the current ParallelismScope.
+
+    Helper threads that can't be had at the start (or that retire to make
+    space for interactive work) are asked for again as this thread works,
+    so that the job picks back up to its full parallelism once the CPUs
+    are free.
+*/
+template<typename DoOne>
+static void runParallel(int occupancyLimit, const DoOne & doOne)
+{
+    ParallelismScope::State * state = currentState;
+    MemoryArena * arena = MemoryArena::current();
+    ResourceUsage * usage = ResourceUsage::current();
+    bool batch = state && state->priority == ParallelPriority::BATCH;
+
+    occupancyLimit = ParallelismScope::limit(occupancyLimit);
+
+    std::atomic<int> finished(0);
+    std::atomic<int> numHelpers(0);
+
+    // This creates a thread pool that runs jobs on the default thread pool
+    ThreadPool tp;
+
+    auto helper = [&] ()
+        {
+            {
+                AdoptParallelismScope adopt(state);
+                MemoryArenaScope adoptArena(arena);
+                ResourceUsageScope adoptUsage(usage);
+                while (!finished.load(std::memory_order_relaxed)) {
+                    if (!doOne()) {
+                        finished = true;
+                        break;
+                    }
+                    if (batch && batchShouldYield())
+                        break;
+                }
+            }
+
+            if (state)
+                state->release();
+            if (batch)
+                --numBatchHelpers;
+            --numHelpers;
+        };
+
+    auto addHelpers = [&] ()
+        {
+            while (numHelpers.load() < occupancyLimit - 1
+                   && !finished.load(std::memory_order_relaxed)) {
+                if (batch && !acquireBatchHelper())
+                    return;
+                if (state && !state->acquire()) {
+                    if (batch)
+                        --numBatchHelpers;
+                    return;
+                }
+                ++numHelpers;
+                tp.add(helper);
+            }
+        };
+
+    addHelpers();
+
+    // Do work until there is nothing left to do, topping up the helpers
+    // every so often
+    for (uint64_t n = 1;  !finished.load(std::memory_order_relaxed);  ++n) {
+        if (!doOne()) {
+            finished = true;
+            break;
+        }
+        if (n % 16 == 0 && numHelpers.load(std::memory_order_relaxed)
+                           < occupancyLimit - 1)
+            addHelpers();
+    }
+
+    // Wait for the rest of the work to be done
+    tp.waitForAll();
+}
+
 void parallelMap(size_t first, size_t last,
                  const std::function<void (size_t)> & doWork,
                  int occupancyLimit)
@@ -26,40 +295,111 @@ void parallelMap(size_t first, size_t last,
     std::atomic<size_t> index(first);
     std::exception_ptr exc;
 
-    // This creates a thread pool that runs jobs on the default thread pool
-    ThreadPool tp;
-
     if (occupancyLimit == -1)
         occupancyLimit = numCpus();
     if (occupancyLimit > (last - first))
         occupancyLimit = (last - first);
 
-    auto worker = [&] ()
+    auto doOne = [&] ()
         {
-            while (!hasException.load(std::memory_order_relaxed)) {
-                size_t myindex = index.fetch_add(1);
-                if (myindex >= last)
-                    return;
-                try {
-                    doWork(myindex);
-                } MLDB_CATCH_ALL {
-                    if (hasException.fetch_add(1) == 0) {
-                        ExcAssert(!exc);
-                        exc = std::current_exception();
-                    }
+            if (hasException.load(std::memory_order_relaxed))
+                return false;
+            size_t myindex = index.fetch_add(1);
+            if (myindex >= last)
+                return false;
+            try {
+                doWork(myindex);
+            } MLDB_CATCH_ALL {
+                if (hasException.fetch_add(1) == 0) {
+                    ExcAssert(!exc);
+                    exc = std::current_exception();
                 }
+                return false;
             }
+            return true;
         };
 
-    // Leave one set of work for this thread to do directly
-    for (int i = 0;  i < occupancyLimit - 1;  ++i)
-        tp.add(worker);
-    
-    // Do work until there is nothing left to do
-    worker();
+    runParallel(occupancyLimit, doOne);
 
-    // Wait for the rest of the work to be done
-    tp.waitForAll();
+    if (exc)
+        std::rethrow_exception(exc);
+}
+
+void parallelMap(size_t first, size_t last,
+                 const std::function<void (size_t)> & doWork,
+                 const LocalityHint & locality,
+                 int occupancyLimit)
+{
+    int numNodes = cpuTopology().numNodes();
+    if (!locality || numNodes == 1) {
+        parallelMap(first, last, doWork, occupancyLimit);
+        return;
+    }
+
+    ExcAssertGreaterEqual(last, first);
+    ExcAssertLess((last - first), 1ULL << 31);
+
+    // One bucket of indexes per node, and a last one for the indexes
+    // without a preference
+    std::vector<std::vector<size_t> > buckets(numNodes + 1);
+    for (size_t i = first;  i < last;  ++i) {
+        int node = locality(i);
+        if (node < 0 || node >= numNodes)
+            node = numNodes;
+        buckets[node].push_back(i);
+    }
+    std::unique_ptr<std::atomic<size_t>[]>
+        taken(new std::atomic<size_t>[numNodes + 1]);
+    for (int i = 0;  i <= numNodes;  ++i)
+        taken[i] = 0;
+
+    std::atomic<int> hasException(0);
+    std::exception_ptr exc;
+
+    if (occupancyLimit == -1)
+        occupancyLimit = numCpus();
+    if (occupancyLimit > (last - first))
+        occupancyLimit = (last - first);
+
+    auto take = [&] (int bucket, size_t & index)
+        {
+            const std::vector<size_t> & indexes = buckets[bucket];
+            if (taken[bucket].load(std::memory_order_relaxed)
+                >= indexes.size())
+                return false;
+            size_t n = taken[bucket].fetch_add(1);
+            if (n >= indexes.size())
+                return false;
+            index = indexes[n];
+            return true;
+        };
+
+    auto doOne = [&] ()
+        {
+            if (hasException.load(std::memory_order_relaxed))
+                return false;
+
+            int home = currentNumaNode();
+            size_t myindex;
+            bool found = take(home, myindex) || take(numNodes, myindex);
+            for (int i = 1;  !found && i < numNodes;  ++i)
+                found = take((home + i) % numNodes, myindex);
+            if (!found)
+                return false;
+
+            try {
+                doWork(myindex);
+            } MLDB_CATCH_ALL {
+                if (hasException.fetch_add(1) == 0) {
+                    ExcAssert(!exc);
+                    exc = std::current_exception();
+                }
+                return false;
+            }
+            return true;
+        };
+
+    runParallel(occupancyLimit, doOne);
 
     if (exc)
         std::rethrow_exception(exc);
@@ -77,45 +417,35 @@ bool parallelMapHaltable(size_t first, size_t last,
     std::atomic<size_t> index(first);
     std::exception_ptr exc;
 
-    // This creates a thread pool that runs jobs on the default thread pool
-    ThreadPool tp;
-
     if (occupancyLimit == -1)
         occupancyLimit = numCpus();
     if (occupancyLimit > (last - first))
         occupancyLimit = (last - first);
 
-    auto worker = [&] ()
+    auto doOne = [&] ()
         {
-            while (!stop.load(std::memory_order_relaxed)
-                   && !hasException.load(std::memory_order_relaxed)) {
-                size_t myindex = index.fetch_add(1);
-                if (myindex >= last)
-                    return;
-                try {
-                    if (!doWork(myindex)) {
-                        stop = true;
-                        return;
-                    }
-                } MLDB_CATCH_ALL {
-                    if (hasException.fetch_add(1) == 0) {
-                        ExcAssert(!exc);
-                        exc = std::current_exception();
-                    }
-                    return;
+            if (stop.load(std::memory_order_relaxed)
+                || hasException.load(std::memory_order_relaxed))
+                return false;
+            size_t myindex = index.fetch_add(1);
+            if (myindex >= last)
+                return false;
+            try {
+                if (!doWork(myindex)) {
+                    stop = true;
+                    return false;
                 }
+            } MLDB_CATCH_ALL {
+                if (hasException.fetch_add(1) == 0) {
+                    ExcAssert(!exc);
+                    exc = std::current_exception();
+                }
+                return false;
             }
+            return true;
         };
 
-    // Leave one set of work for this thread to do directly
-    for (int i = 0;  i < occupancyLimit - 1;  ++i)
-        tp.add(worker);
-    
-    // Do work until there is nothing left to do
-    worker();
-
-    // Wait for the rest of the work to be done
-    tp.waitForAll();
+    runParallel(occupancyLimit, doOne);
 
     if (exc)
         std::rethrow_exception(exc);
@@ -136,41 +466,32 @@ void parallelMapChunked(size_t first, size_t last, size_t chunkSize,
     std::atomic<size_t> index(first);
     std::exception_ptr exc;
 
-    // This creates a thread pool that runs jobs on the default thread pool
-    ThreadPool tp;
-    
     if (occupancyLimit == -1)
         occupancyLimit = numCpus();
     if (occupancyLimit > (last - first + chunkSize - 1) / chunkSize)
         occupancyLimit = (last - first + chunkSize - 1) / chunkSize;
 
-    auto worker = [&] ()
+    auto doOne = [&] ()
         {
-            while (!hasException.load(std::memory_order_relaxed)) {
-                size_t myindex = index.fetch_add(chunkSize);
-                if (myindex >= last)
-                    return;
-                size_t indexEnd = std::min(last, myindex + chunkSize);
-                try {
-                    doWork(myindex, indexEnd);
-                } MLDB_CATCH_ALL {
-                    if (hasException.fetch_add(1) == 0) {
-                        ExcAssert(!exc);
-                        exc = std::current_exception();
-                    }
+            if (hasException.load(std::memory_order_relaxed))
+                return false;
+            size_t myindex = index.fetch_add(chunkSize);
+            if (myindex >= last)
+                return false;
+            size_t indexEnd = std::min(last, myindex + chunkSize);
+            try {
+                doWork(myindex, indexEnd);
+            } MLDB_CATCH_ALL {
+                if (hasException.fetch_add(1) == 0) {
+                    ExcAssert(!exc);
+                    exc = std::current_exception();
                 }
+                return false;
             }
+            return true;
         };
 
-    // Leave one set of work for this thread to do directly
-    for (int i = 0;  i < occupancyLimit - 1;  ++i)
-        tp.add(worker);
-    
-    // Do work until there is nothing left to do
-    worker();
-    
-    // Wait for the rest of the work to be done
-    tp.waitForAll();
+    runParallel(occupancyLimit, doOne);
 
     if (exc)
         std::rethrow_exception(exc);
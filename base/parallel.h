@@ -8,9 +8,77 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 
 namespace MLDB {
 
+
+/*****************************************************************************/
+/* PARALLELISM SCOPE                                                         */
+/*****************************************************************************/
+
+/** Priority class of the work done on a thread.  Interactive work is
+    latency sensitive (queries and function calls made over REST); batch
+    work is throughput oriented (procedure runs).
+*/
+enum class ParallelPriority {
+    INTERACTIVE,
+    BATCH
+};
+
+/** While in scope, limits the parallelism of the work started on this
+    thread and sets its priority class.
+
+    The limit is on the total number of threads that work on behalf of the
+    scope at once, including the thread that opened it, across all of the
+    parallelMap() calls (nested or not) that are made within it.  A limit
+    of one runs everything on the calling thread.  Scopes nest; the
+    innermost priority applies, and the limit is the tightest of the
+    enclosing ones.
+
+    Batch work shares the CPUs fairly with interactive work: while any
+    interactive scope is open, the helper threads of all batch scopes
+    together are limited to batchThreadShare(), and the ones above that
+    retire once they finish their current job.  The thread that started a
+    batch job always keeps working on it, so batch work only ever slows
+    down and is never starved.
+*/
+struct ParallelismScope {
+    ParallelismScope(int maxParallelism = -1,
+                     ParallelPriority priority = ParallelPriority::INTERACTIVE);
+    ~ParallelismScope();
+
+    ParallelismScope(const ParallelismScope &) = delete;
+    void operator = (const ParallelismScope &) = delete;
+
+    /// Maximum number of threads for the current scope, or -1 if unlimited
+    static int maxParallelism();
+
+    /// Return the given number of threads (-1 meaning as many as there
+    /// are CPUs) limited to the maximum for the current scope
+    static int limit(int numThreads);
+
+    /// Priority of the current scope; interactive if there is none
+    static ParallelPriority priority();
+
+    /// Number of interactive scopes currently open, over all threads
+    static int numInteractive();
+
+    /// Number of threads batch work may use while interactive work is
+    /// running.  Defaults to half of the CPUs or the value of the
+    /// MLDB_BATCH_THREAD_SHARE environment variable.
+    static int batchThreadShare();
+
+    /// Change the batch thread share.  Mostly useful for tests.
+    static void setBatchThreadShare(int numThreads);
+
+    struct State;
+
+private:
+    std::shared_ptr<State> state;
+    State * previous;
+};
+
 /** Run a set of jobs in multiple threads.
 
     This will count from first to last, submitting a job to doWork for
@@ -18,6 +86,7 @@ namespace MLDB {
 
     A maximum of occupancyLimit jobs will be run in parallel at once.  This
     is useful for limiting lock contention in a downstream reduction job.
+    The current ParallelismScope may limit it further.
 
     The doWork() function is permitted to throw an exception.  In the case
     that an exception is thrown, the following behaviour will happen:
@@ -39,6 +108,23 @@ void parallelMap(size_t first, size_t last,
                  const std::function<void (size_t)> & doWork,
                  int occupancyLimit = -1);
 
+/** Returns the NUMA node (as numbered by cpuTopology()) holding the memory
+    that the job for the given index works on, or -1 if it doesn't matter.
+*/
+typedef std::function<int (size_t)> LocalityHint;
+
+/** Same as parallelMap(), but each job is preferentially run by a thread
+    on the NUMA node that locality() returns for it.  Threads take the jobs
+    of their own node first, then those without a preference, and only then
+    help out with the jobs of other nodes.  locality() is called once per
+    index, before any work starts.  On machines with a single node this is
+    the same as parallelMap().
+*/
+void parallelMap(size_t first, size_t last,
+                 const std::function<void (size_t)> & doWork,
+                 const LocalityHint & locality,
+                 int occupancyLimit = -1);
+
 /** Same as parallelMap(), but takes a lambda which will short-circuit the
     work if it returns false.  Returns false if and only if a doWork()
     call returned false.
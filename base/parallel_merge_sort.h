@@ -13,6 +13,7 @@
 #include <memory>
 
 #include "mldb/base/thread_pool.h"
+#include "mldb/base/parallel_radix_sort.h"
 
 
 namespace MLDB {
@@ -253,12 +254,22 @@ parallelQuickSortRecursive(typename std::vector<T>::iterator begin, typename std
     tp.waitForAll();
 }
 
+/** Sort the whole vector.  Fixed width keys (integers, hashes and pairs of
+    them) sorted in their natural order use a parallel radix sort instead,
+    which gives the same result in far less time.
+*/
 template<class T, class Compare = std::less<T> >
 void 
 parallelQuickSortRecursive(std::vector<T> & vec)
 {
-    return parallelQuickSortRecursive<T, Compare>(vec.begin(), vec.end(),
-                                                  Compare());
+    if constexpr (RadixSortKey<T>::enabled
+                  && std::is_same<Compare, std::less<T> >::value) {
+        parallelRadixSort(vec);
+    }
+    else {
+        parallelQuickSortRecursive<T, Compare>(vec.begin(), vec.end(),
+                                               Compare());
+    }
 }
 
 
@@ -0,0 +1,244 @@
+/* parallel_radix_sort.h                                           -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Parallel radix sort for fixed width keys, like row and column hashes and
+   (hash, index) pairs.  These are sorted in a handful of linear passes
+   rather than the n log n comparisons of a comparison sort.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <cmath>
+
+#include "mldb/base/radix_sort_key.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/base/parallel.h"
+
+
+namespace MLDB {
+
+/** Compare two values on their radix sort key, most significant byte
+    first.
+*/
+template<typename T, typename Key = RadixSortKey<T> >
+bool radixKeyLess(const T & v1, const T & v2)
+{
+    for (int b = Key::numBytes - 1;  b >= 0;  --b) {
+        unsigned d1 = Key::digit(v1, b), d2 = Key::digit(v2, b);
+        if (d1 != d2)
+            return d1 < d2;
+    }
+    return false;
+}
+
+/** Comparison sort of [first, last) on the radix key.  The default key
+    promises the same order as std::less, which is a lot faster than going
+    byte by byte.
+*/
+template<typename T, typename Key>
+void radixComparisonSort(T * first, T * last)
+{
+    if (std::is_same<Key, RadixSortKey<T> >::value)
+        std::sort(first, last, std::less<T>());
+    else std::sort(first, last, radixKeyLess<T, Key>);
+}
+
+/** Single threaded radix sort of the n values at src on the bytes below
+    numBytes, using dst (which has room for n values) as scratch.  Returns
+    where the sorted values are, which is either src or dst.
+
+    When there are few enough bytes for the size of the range, this is an
+    LSD radix sort which skips the bytes that are the same for all values.
+    Otherwise (for example the low bytes of (hash, index) pairs, where the
+    hash is nearly always enough to order them) the values are split on
+    their top byte and each of the parts is sorted on its own, with small
+    parts using a comparison sort.
+*/
+template<typename T, typename Key = RadixSortKey<T> >
+T * radixSortBytes(T * src, T * dst, size_t n, int numBytes)
+{
+    if (n < 256 || numBytes == 0) {
+        radixComparisonSort<T, Key>(src, src + n);
+        return src;
+    }
+
+    // Each LSD pass costs about the same as log2(n) / 2 comparisons per
+    // value
+    if (numBytes > std::log2(n) / 2) {
+        int b = numBytes - 1;
+        size_t offsets[257] = { 0 };
+        for (size_t i = 0;  i < n;  ++i)
+            ++offsets[Key::digit(src[i], b) + 1];
+        if (offsets[Key::digit(src[0], b) + 1] == n)
+            return radixSortBytes<T, Key>(src, dst, n, b);
+
+        for (unsigned d = 0;  d < 256;  ++d)
+            offsets[d + 1] += offsets[d];
+
+        size_t starts[257];
+        std::copy(offsets, offsets + 257, starts);
+
+        for (size_t i = 0;  i < n;  ++i)
+            dst[offsets[Key::digit(src[i], b)]++] = src[i];
+
+        for (unsigned d = 0;  d < 256;  ++d) {
+            size_t first = starts[d], last = starts[d + 1];
+            if (first == last)
+                continue;
+            T * result = radixSortBytes<T, Key>(dst + first, src + first,
+                                                last - first, b);
+            if (result != dst + first)
+                std::copy(result, result + (last - first), dst + first);
+        }
+
+        return dst;
+    }
+
+    std::vector<size_t> counts(numBytes * 256);
+    for (size_t i = 0;  i < n;  ++i) {
+        for (int b = 0;  b < numBytes;  ++b)
+            ++counts[b * 256 + Key::digit(src[i], b)];
+    }
+
+    for (int b = 0;  b < numBytes;  ++b) {
+        if (counts[b * 256 + Key::digit(src[0], b)] == n)
+            continue;  // same for all values
+
+        size_t offsets[256];
+        size_t total = 0;
+        for (unsigned d = 0;  d < 256;  ++d) {
+            offsets[d] = total;
+            total += counts[b * 256 + d];
+        }
+
+        for (size_t i = 0;  i < n;  ++i)
+            dst[offsets[Key::digit(src[i], b)]++] = src[i];
+
+        std::swap(src, dst);
+    }
+
+    return src;
+}
+
+/** Sort vec on the key described by Key.  The first pass splits the values
+    on the most significant byte that isn't the same for all of them, with
+    chunks of the input counted and scattered in parallel.  The 256
+    buckets that come out of that pass are then independent and are each
+    sorted on the lower bytes by radixSortBytes(), again in parallel.
+    Below threadThreshold values everything runs on the calling thread.
+
+    The sort needs a scratch buffer the size of vec.  It is not stable,
+    which doesn't matter as values with the same key are the same.
+*/
+template<typename T, typename Key = RadixSortKey<T> >
+void parallelRadixSort(std::vector<T> & vec,
+                       size_t threadThreshold = 100000)
+{
+    static_assert(Key::enabled, "type has no radix sort key");
+
+    constexpr int numBytes = Key::numBytes;
+    size_t n = vec.size();
+
+    if (n < 256) {
+        radixComparisonSort<T, Key>(vec.data(), vec.data() + n);
+        return;
+    }
+
+    std::unique_ptr<T[]> buf(new T[n]);
+
+    if (n < threadThreshold) {
+        T * result = radixSortBytes<T, Key>(vec.data(), buf.get(), n,
+                                            numBytes);
+        if (result != vec.data())
+            std::copy(result, result + n, vec.data());
+        return;
+    }
+
+    // A few chunks per CPU, so that a slow thread doesn't hold up a pass
+    size_t numChunks = std::max<size_t>(1, std::min<size_t>(4 * numCpus(),
+                                                            n / (threadThreshold / 2)));
+    size_t chunkSize = (n + numChunks - 1) / numChunks;
+
+    T * src = vec.data();
+    T * dst = buf.get();
+
+    auto forEachChunk = [&] (const std::function<void (size_t, size_t, size_t)> & fn)
+        {
+            parallelMap(0, numChunks,
+                        [&] (size_t c)
+                        {
+                            size_t first = c * chunkSize;
+                            size_t last = std::min(n, first + chunkSize);
+                            fn(c, first, last);
+                        });
+        };
+
+    // Count the most significant byte that isn't the same for all of the
+    // values; for hashes that is the first one tried
+    std::vector<size_t> counts(numChunks * 256);
+
+    int msb = numBytes - 1;
+    for (;  msb >= 0;  --msb) {
+        forEachChunk([&] (size_t c, size_t first, size_t last)
+                     {
+                         size_t * chunkCounts = &counts[c * 256];
+                         std::fill(chunkCounts, chunkCounts + 256, 0);
+                         for (size_t i = first;  i < last;  ++i)
+                             ++chunkCounts[Key::digit(src[i], msb)];
+                     });
+
+        unsigned d0 = Key::digit(src[0], msb);
+        size_t numWithD0 = 0;
+        for (size_t c = 0;  c < numChunks;  ++c)
+            numWithD0 += counts[c * 256 + d0];
+        if (numWithD0 != n)
+            break;
+    }
+
+    if (msb < 0)
+        return;  // all values have the same key
+
+    // Scatter on the most significant byte.  Each chunk writes its values
+    // with digit d after those with a lower digit, and after those of
+    // earlier chunks with digit d.
+    std::vector<size_t> offsets(numChunks * 256);
+    size_t bucketStarts[257];
+    size_t total = 0;
+    for (unsigned d = 0;  d < 256;  ++d) {
+        bucketStarts[d] = total;
+        for (size_t c = 0;  c < numChunks;  ++c) {
+            offsets[c * 256 + d] = total;
+            total += counts[c * 256 + d];
+        }
+    }
+    bucketStarts[256] = total;
+
+    forEachChunk([&] (size_t c, size_t first, size_t last)
+                 {
+                     size_t * chunkOffsets = &offsets[c * 256];
+                     for (size_t i = first;  i < last;  ++i)
+                         dst[chunkOffsets[Key::digit(src[i], msb)]++] = src[i];
+                 });
+
+    // Now the buckets are in dst, and each one can use the same range of
+    // src as its scratch space
+    parallelMap(0, 256,
+                [&] (size_t d)
+                {
+                    size_t first = bucketStarts[d];
+                    size_t last = bucketStarts[d + 1];
+                    if (first == last)
+                        return;
+                    T * result
+                        = radixSortBytes<T, Key>(dst + first, src + first,
+                                                 last - first, msb);
+                    if (result != src + first)
+                        std::copy(result, result + (last - first),
+                                  src + first);
+                });
+}
+
+} // namespace MLDB
@@ -122,6 +122,45 @@ struct ParseContext {
         return *this;
     }
 
+    /** Return the current position within the current buffer.  The
+        characters from there up to get_buffer_end() can be read directly,
+        for example to scan them a block at a time, and then skipped with
+        advance_in_buffer().
+    */
+    const char * get_buffer_pos() const { return cur_; }
+
+    /** Return the end of the current buffer. */
+    const char * get_buffer_end() const { return ebuf_; }
+
+    /** Skip the next n characters, which must all be within the current
+        buffer.  This is equivalent to n calls to operator ++, but doesn't
+        look at the characters one at a time.
+    */
+    void advance_in_buffer(size_t n)
+    {
+        if (n == 0)
+            return;
+        if (MLDB_UNLIKELY(n > (size_t)(ebuf_ - cur_)))
+            exception("advance_in_buffer() past the end of the buffer");
+
+        // Keep the line and column numbers up to date
+        const char * end = cur_ + n;
+        const char * lastNewline = nullptr;
+        for (const char * p = cur_;
+             (p = (const char *)memchr(p, '\n', end - p));  ++p) {
+            ++line_;
+            lastNewline = p;
+        }
+        if (lastNewline)
+            col_ = end - lastNewline;
+        else col_ += n;
+
+        ofs_ += n;
+        cur_ = end;
+        if (cur_ == ebuf_)
+            next_buffer();
+    }
+
     ParseContext & operator += (int steps)
     {
         for (int i = 0; i < steps; i++) {
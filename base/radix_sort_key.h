@@ -0,0 +1,71 @@
+/* radix_sort_key.h                                                -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Traits describing how to radix sort a fixed width type.  This is kept
+   apart from parallel_radix_sort.h so that types can be hooked up without
+   pulling in the thread pool.
+*/
+
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include <cstdint>
+
+namespace MLDB {
+
+/** Describes the key of a type that can be radix sorted.  Specializations
+    that set enabled to true also provide:
+
+    - numBytes, the width of the key in bytes; and
+    - digit(val, byte), which returns byte number byte (zero being the least
+      significant) of the key for val.
+
+    Sorting on the key must give the same order as std::less<T>, and two
+    values with the same key must be indistinguishable, so that the
+    radix sort can be substituted for a comparison sort.
+*/
+template<typename T, typename Enable = void>
+struct RadixSortKey {
+    static constexpr bool enabled = false;
+};
+
+/** Integers sort on their value; the sign bit of signed integers is
+    flipped so that negative values sort first.
+*/
+template<typename T>
+struct RadixSortKey<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+    static constexpr bool enabled = true;
+    static constexpr int numBytes = sizeof(T);
+
+    static unsigned digit(T val, int byte)
+    {
+        typedef typename std::make_unsigned<T>::type Unsigned;
+        Unsigned u = val;
+        if (std::is_signed<T>::value)
+            u ^= Unsigned(1) << (8 * sizeof(T) - 1);
+        return (u >> (8 * byte)) & 255;
+    }
+};
+
+/** Pairs sort on their first member, then their second, like
+    std::less<std::pair>.
+*/
+template<typename T1, typename T2>
+struct RadixSortKey<std::pair<T1, T2>,
+                    typename std::enable_if<RadixSortKey<T1>::enabled
+                                            && RadixSortKey<T2>::enabled>::type> {
+    static constexpr bool enabled = true;
+    static constexpr int numBytes
+        = RadixSortKey<T1>::numBytes + RadixSortKey<T2>::numBytes;
+
+    static unsigned digit(const std::pair<T1, T2> & val, int byte)
+    {
+        if (byte < RadixSortKey<T2>::numBytes)
+            return RadixSortKey<T2>::digit(val.second, byte);
+        return RadixSortKey<T1>::digit(val.first,
+                                       byte - RadixSortKey<T2>::numBytes);
+    }
+};
+
+} // namespace MLDB
@@ -0,0 +1,151 @@
+/** resource_usage.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Implementation of resource accounting.
+*/
+
+#include "mldb/base/resource_usage.h"
+#include <time.h>
+
+
+namespace MLDB {
+
+namespace {
+
+static __thread ResourceUsageScope * currentScope = nullptr;
+static __thread ResourceUsage * currentUsage = nullptr;
+
+uint64_t threadCpuNanoseconds()
+{
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == -1)
+        return 0;
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+std::atomic<uint64_t> nextUsageId(1);
+
+/// Counter that the last row counted on this thread went to
+struct RowCounterCache {
+    uint64_t usageId = 0;
+    std::string dataset;
+    std::atomic<uint64_t> * counter = nullptr;
+};
+
+static thread_local RowCounterCache rowCounterCache;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* RESOURCE USAGE                                                            */
+/*****************************************************************************/
+
+ResourceUsage::
+ResourceUsage(std::string name)
+    : name_(std::move(name)), id(nextUsageId++)
+{
+}
+
+ResourceUsageStats
+ResourceUsage::
+stats() const
+{
+    ResourceUsageStats result;
+    result.cpuSeconds = cpuNanoseconds.load() / 1000000000.0;
+
+    std::unique_lock<std::mutex> guard(mutex);
+    for (auto & r: rowsScanned)
+        result.rowsScanned[r.first] = r.second->value.load();
+    result.bytesRead = bytesRead;
+    return result;
+}
+
+std::atomic<uint64_t> &
+ResourceUsage::
+rowsScannedCounter(const std::string & dataset)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    auto & counter = rowsScanned[dataset];
+    if (!counter)
+        counter.reset(new Counter());
+    return counter->value;
+}
+
+void
+ResourceUsage::
+addBytesRead(const std::string & scheme, uint64_t bytes)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    bytesRead[scheme] += bytes;
+}
+
+void
+ResourceUsage::
+countRowScanned(const std::string & dataset)
+{
+    ResourceUsage * usage = currentUsage;
+    if (!usage)
+        return;
+
+    RowCounterCache & cache = rowCounterCache;
+    if (cache.usageId != usage->id || cache.dataset != dataset) {
+        cache.counter = &usage->rowsScannedCounter(dataset);
+        cache.usageId = usage->id;
+        cache.dataset = dataset;
+    }
+
+    cache.counter->fetch_add(1, std::memory_order_relaxed);
+}
+
+ResourceUsage *
+ResourceUsage::
+current()
+{
+    return currentUsage;
+}
+
+
+/*****************************************************************************/
+/* RESOURCE USAGE SCOPE                                                      */
+/*****************************************************************************/
+
+ResourceUsageScope::
+ResourceUsageScope(ResourceUsage * usage)
+    : usage(usage), previous(currentScope)
+{
+    // The time up to now belongs to the enclosing scope
+    if (previous)
+        previous->flush();
+
+    cpuStart = threadCpuNanoseconds();
+    currentScope = this;
+    currentUsage = usage;
+}
+
+ResourceUsageScope::
+~ResourceUsageScope()
+{
+    uint64_t now = threadCpuNanoseconds();
+    if (usage)
+        usage->addCpuNanoseconds(now - cpuStart);
+
+    // The enclosing scope starts counting again from here
+    if (previous)
+        previous->cpuStart = now;
+
+    currentScope = previous;
+    currentUsage = previous ? previous->usage : nullptr;
+}
+
+void
+ResourceUsageScope::
+flush()
+{
+    uint64_t now = threadCpuNanoseconds();
+    if (usage)
+        usage->addCpuNanoseconds(now - cpuStart);
+    cpuStart = now;
+}
+
+} // namespace MLDB
@@ -0,0 +1,133 @@
+/** resource_usage.h                                               -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Accounting of the resources (CPU time, rows scanned, bytes read) used by
+    a query or a procedure run over all of the threads that work on it.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <cstdint>
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* RESOURCE USAGE                                                            */
+/*****************************************************************************/
+
+/** Snapshot of the resources used by a piece of work. */
+struct ResourceUsageStats {
+    double cpuSeconds = 0.0;          ///< CPU time over all threads
+    std::map<std::string, uint64_t> rowsScanned;  ///< By dataset
+    std::map<std::string, uint64_t> bytesRead;    ///< By VFS scheme
+};
+
+/** Accumulates the resources used by a piece of work.  CPU time is added
+    by the ResourceUsageScope objects of each thread that does some of the
+    work; the other counters are added to directly by the code that uses
+    the resource, through current().
+
+    This should be created with std::make_shared, so that things that
+    outlive the scope they were created in (such as streams) can keep a
+    reference to it.  It may be used from several threads at once.
+*/
+struct ResourceUsage: public std::enable_shared_from_this<ResourceUsage> {
+    ResourceUsage(std::string name = "");
+
+    ResourceUsage(const ResourceUsage &) = delete;
+    void operator = (const ResourceUsage &) = delete;
+
+    const std::string & name() const { return name_; }
+
+    /** Return the resources used so far.  CPU time of scopes that are
+        still open is only included up to their last flush().
+    */
+    ResourceUsageStats stats() const;
+
+    void addCpuNanoseconds(uint64_t ns)
+    {
+        cpuNanoseconds.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    /** Return a counter for the rows scanned from the given dataset,
+        which may be incremented directly.  The counter stays valid as
+        long as this object.
+    */
+    std::atomic<uint64_t> & rowsScannedCounter(const std::string & dataset);
+
+    /** Count a row scanned from the given dataset against the current
+        usage, if there is one.  This is cheap enough to be called once
+        per row: the counter is cached per thread.
+    */
+    static void countRowScanned(const std::string & dataset);
+
+    void addBytesRead(const std::string & scheme, uint64_t bytes);
+
+    /** Usage of the innermost ResourceUsageScope on this thread, or of the
+        thread that started the parallelMap() job it is running.  Null if
+        there is none.
+    */
+    static ResourceUsage * current();
+
+private:
+    std::string name_;
+
+    /// Unique over the life of the process, unlike our address, so that
+    /// cached counters can't be confused with those of a later usage
+    uint64_t id;
+
+    std::atomic<uint64_t> cpuNanoseconds{0};
+
+    mutable std::mutex mutex;
+
+    /// Counters are on their own cache line, as they're incremented once
+    /// per row from many threads
+    struct alignas(64) Counter {
+        std::atomic<uint64_t> value{0};
+    };
+
+    std::map<std::string, std::unique_ptr<Counter> > rowsScanned;
+    std::map<std::string, uint64_t> bytesRead;
+};
+
+
+/*****************************************************************************/
+/* RESOURCE USAGE SCOPE                                                      */
+/*****************************************************************************/
+
+/** While in scope, makes the given usage (which may be null for none) the
+    current one for this thread and for the helper threads of the
+    parallelMap() calls made within it, and adds the CPU time that this
+    thread spends in the scope to it.
+
+    When scopes are nested on a thread, the CPU time spent in the inner
+    one is only added to the inner one's usage, so that no time is
+    counted twice when a thread helping with a job picks up more of the
+    same job while it waits.
+*/
+struct ResourceUsageScope {
+    ResourceUsageScope(ResourceUsage * usage);
+    ~ResourceUsageScope();
+
+    ResourceUsageScope(const ResourceUsageScope &) = delete;
+    void operator = (const ResourceUsageScope &) = delete;
+
+    /** Add the CPU time this thread has spent in the scope so far to the
+        usage, so that it's included in its stats().  Must be called from
+        the thread that created the scope.
+    */
+    void flush();
+
+private:
+    ResourceUsage * usage;
+    ResourceUsageScope * previous;
+    uint64_t cpuStart;
+};
+
+} // namespace MLDB
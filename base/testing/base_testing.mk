@@ -4,3 +4,8 @@ export MLDB_NO_TIMING_TESTS=1
 $(eval $(call test,thread_pool_test,base,boost timed))
 $(eval $(call test,thread_queue_test,base,boost timed))
 $(eval $(call test,per_thread_accumulator_test,base,boost))
+$(eval $(call test,parallelism_scope_test,base,boost))
+$(eval $(call test,memory_arena_test,base,boost))
+$(eval $(call test,resource_usage_test,base,boost))
+$(eval $(call test,parallel_radix_sort_test,base types,boost))
+$(eval $(call test,parallel_radix_sort_benchmark,base,boost manual))
@@ -0,0 +1,131 @@
+/** memory_arena_test.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test of memory arenas.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/base/memory_arena.h"
+#include "mldb/base/parallel.h"
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <set>
+#include <atomic>
+#include <cstring>
+
+using namespace std;
+using namespace MLDB;
+
+BOOST_AUTO_TEST_CASE(test_allocate_and_free)
+{
+    MemoryArena arena("test");
+    BOOST_CHECK_EQUAL(arena.name(), "test");
+    BOOST_CHECK_EQUAL(arena.stats().bytesReserved, 0);
+
+    void * p1 = arena.allocate(100);
+    void * p2 = arena.allocate(100);
+    BOOST_CHECK_NE(p1, p2);
+    BOOST_CHECK_EQUAL((size_t)p1 % alignof(std::max_align_t), 0);
+    memset(p1, 1, 100);
+    memset(p2, 2, 100);
+
+    auto stats = arena.stats();
+    BOOST_CHECK_EQUAL(stats.bytesInUse, 200);
+    BOOST_CHECK_EQUAL(stats.numAllocations, 2);
+    BOOST_CHECK_GT(stats.bytesReserved, 0);
+
+    // A freed slab is reused by the next allocation of its size
+    arena.deallocate(p1, 100);
+    void * p3 = arena.allocate(120);
+    BOOST_CHECK_EQUAL(p1, p3);
+    arena.deallocate(p3, 120);
+    arena.deallocate(p2, 100);
+
+    stats = arena.stats();
+    BOOST_CHECK_EQUAL(stats.bytesInUse, 0);
+    BOOST_CHECK_EQUAL(stats.peakBytesInUse, 220);
+}
+
+BOOST_AUTO_TEST_CASE(test_large_allocations)
+{
+    MemoryArena arena;
+    size_t before = arena.stats().bytesReserved;
+
+    size_t size = 10 << 20;
+    char * p = (char *)arena.allocate(size, 4096);
+    BOOST_CHECK_EQUAL((size_t)p % 4096, 0);
+    memset(p, 0, size);
+    BOOST_CHECK_GE(arena.stats().bytesReserved, before + size);
+
+    // Large allocations go straight back to the OS
+    arena.deallocate(p, size, 4096);
+    BOOST_CHECK_EQUAL(arena.stats().bytesReserved, before);
+    BOOST_CHECK_GE(arena.stats().peakBytesReserved, before + size);
+}
+
+BOOST_AUTO_TEST_CASE(test_alignment)
+{
+    MemoryArena arena;
+    for (size_t align: { 1, 8, 16, 32, 64, 128, 4096 }) {
+        for (size_t size: { 1, 7, 48, 1000, 40000 }) {
+            void * p = arena.allocate(size, align);
+            BOOST_CHECK_EQUAL((size_t)p % align, 0);
+            arena.deallocate(p, size, align);
+        }
+    }
+    BOOST_CHECK_EQUAL(arena.stats().bytesInUse, 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_pmr_containers)
+{
+    MemoryArena arena;
+    {
+        std::pmr::vector<int> v(&arena);
+        for (int i = 0;  i < 100000;  ++i)
+            v.push_back(i);
+        std::pmr::set<int> s(v.begin(), v.begin() + 1000, &arena);
+        BOOST_CHECK_EQUAL(s.size(), 1000);
+        BOOST_CHECK_EQUAL(v[99999], 99999);
+        BOOST_CHECK_GE(arena.stats().bytesInUse,
+                       100000 * sizeof(int) + 1000 * sizeof(int));
+    }
+    BOOST_CHECK_EQUAL(arena.stats().bytesInUse, 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_scope)
+{
+    BOOST_CHECK(MemoryArena::current() == nullptr);
+    BOOST_CHECK(MemoryArena::currentResource()
+                == std::pmr::new_delete_resource());
+
+    MemoryArena arena;
+    {
+        MemoryArenaScope scope(&arena);
+        BOOST_CHECK_EQUAL(MemoryArena::current(), &arena);
+        BOOST_CHECK_EQUAL(MemoryArena::currentResource(), &arena);
+
+        {
+            MemoryArenaScope none(nullptr);
+            BOOST_CHECK(MemoryArena::current() == nullptr);
+        }
+        BOOST_CHECK_EQUAL(MemoryArena::current(), &arena);
+
+        // The helper threads of a parallel job see the arena too, and can
+        // allocate from it at the same time
+        std::atomic<int> numInArena(0);
+        parallelMap(0, 64, [&] (size_t i)
+                    {
+                        numInArena += MemoryArena::current() == &arena;
+                        std::pmr::vector<int> v(MemoryArena::currentResource());
+                        for (int j = 0;  j < 10000;  ++j)
+                            v.push_back(j);
+                    });
+        BOOST_CHECK_EQUAL(numInArena, 64);
+    }
+    BOOST_CHECK(MemoryArena::current() == nullptr);
+    BOOST_CHECK_EQUAL(arena.stats().bytesInUse, 0);
+    BOOST_CHECK_GT(arena.stats().numAllocations, 64);
+}
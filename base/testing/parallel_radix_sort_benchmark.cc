@@ -0,0 +1,84 @@
+/** parallel_radix_sort_benchmark.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Benchmark of the parallel radix sort against the parallel quicksort, on
+    random 64 bit hashes and (hash, index) pairs.  Sizes go up by a factor
+    of ten from 10M up to PARALLEL_RADIX_SORT_BENCHMARK_SIZE, which defaults
+    to 100M; set it to 1000000000 for the 1B element run (which needs
+    about 48GB of memory for the pairs).
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/base/parallel_radix_sort.h"
+#include "mldb/base/parallel_merge_sort.h"
+#include "mldb/arch/timers.h"
+#include "mldb/arch/format.h"
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <iostream>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+size_t maxSize()
+{
+    size_t result = 100000000;
+    if (getenv("PARALLEL_RADIX_SORT_BENCHMARK_SIZE"))
+        result = std::stoull(getenv("PARALLEL_RADIX_SORT_BENCHMARK_SIZE"));
+    return result;
+}
+
+template<typename T, typename Generate>
+void benchmark(const char * name, Generate && generate)
+{
+    for (size_t size = 10000000;  size <= maxSize();  size *= 10) {
+        std::vector<T> input(size);
+        parallelMapChunked(0, size, 1 << 20,
+                           [&] (size_t first, size_t last)
+                           {
+                               std::mt19937_64 rng(first);
+                               for (size_t i = first;  i < last;  ++i)
+                                   input[i] = generate(rng, i);
+                           });
+
+        std::vector<T> v1 = input;
+        Timer timer;
+        parallelQuickSortRecursive<T>(v1.begin(), v1.end(), std::less<T>());
+        double quickSeconds = timer.elapsed_wall();
+
+        std::vector<T> v2 = std::move(input);
+        timer.restart();
+        parallelRadixSort(v2);
+        double radixSeconds = timer.elapsed_wall();
+
+        BOOST_CHECK(v1 == v2);
+
+        cerr << MLDB::format("%-12s %11zd quicksort %8.3fs radix %8.3fs "
+                             "speedup %5.2fx\n",
+                             name, size, quickSeconds, radixSeconds,
+                             quickSeconds / radixSeconds);
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(benchmark_hashes)
+{
+    benchmark<uint64_t>("hash",
+                        [] (std::mt19937_64 & rng, size_t) { return rng(); });
+}
+
+BOOST_AUTO_TEST_CASE(benchmark_hash_index_pairs)
+{
+    benchmark<std::pair<uint64_t, uint64_t> >
+        ("hash,index",
+         [] (std::mt19937_64 & rng, size_t i)
+         {
+             return std::make_pair(rng(), uint64_t(i));
+         });
+}
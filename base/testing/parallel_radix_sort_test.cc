@@ -0,0 +1,120 @@
+/** parallel_radix_sort_test.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test of the parallel radix sort, against std::sort.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/base/parallel_radix_sort.h"
+#include "mldb/base/parallel_merge_sort.h"
+#include "mldb/types/hash_wrapper.h"
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+/** Sort a copy of vec both ways and check that they agree.  A small
+    thread threshold makes even the medium sizes go through the parallel
+    path.
+*/
+template<typename T>
+void checkSort(const std::vector<T> & vec)
+{
+    std::vector<T> expected = vec;
+    std::sort(expected.begin(), expected.end());
+
+    for (size_t threshold: { size_t(100), size_t(100000) }) {
+        std::vector<T> sorted = vec;
+        parallelRadixSort(sorted, threshold);
+        BOOST_REQUIRE(sorted == expected);
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(test_unsigned)
+{
+    std::mt19937_64 rng(1);
+    for (size_t n: { 0, 1, 2, 63, 64, 1000, 100000, 1000000 }) {
+        std::vector<uint64_t> vec(n);
+        for (auto & v: vec)
+            v = rng();
+        checkSort(vec);
+
+        // Small values skip the high bytes
+        for (auto & v: vec)
+            v = rng() % 1000;
+        checkSort(vec);
+
+        // All the same skips every pass
+        std::fill(vec.begin(), vec.end(), 12345);
+        checkSort(vec);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_signed)
+{
+    std::mt19937 rng(2);
+    std::vector<int> vec(10000);
+    for (auto & v: vec)
+        v = int(rng());
+    vec[0] = std::numeric_limits<int>::min();
+    vec[1] = std::numeric_limits<int>::max();
+    vec[2] = 0;
+    vec[3] = -1;
+    checkSort(vec);
+
+    std::vector<int8_t> bytes(1000);
+    for (auto & v: bytes)
+        v = rng();
+    checkSort(bytes);
+}
+
+BOOST_AUTO_TEST_CASE(test_pairs)
+{
+    std::mt19937 rng(3);
+    std::vector<std::pair<uint32_t, uint32_t> > vec(100000);
+    for (auto & v: vec)
+        v = { rng() % 100, rng() };
+    checkSort(vec);
+
+    std::vector<std::pair<uint64_t, int> > vec2(100000);
+    for (auto & v: vec2)
+        v = { rng() % 1000, int(rng() % 10) - 5 };
+    checkSort(vec2);
+}
+
+BOOST_AUTO_TEST_CASE(test_hashes)
+{
+    std::mt19937_64 rng(4);
+    std::vector<SH> vec(100000);
+    for (auto & v: vec)
+        v = SH(rng());
+    checkSort(vec);
+}
+
+BOOST_AUTO_TEST_CASE(test_quick_sort_uses_radix)
+{
+    // Both go through parallelQuickSortRecursive; the radix sort must give
+    // the same answer as the comparison sort it replaces
+    std::mt19937_64 rng(5);
+    std::vector<uint64_t> vec(100000);
+    for (auto & v: vec)
+        v = rng();
+    std::vector<uint64_t> expected = vec;
+    std::sort(expected.begin(), expected.end());
+
+    parallelQuickSortRecursive(vec);
+    BOOST_CHECK(vec == expected);
+
+    // A custom comparison still uses the comparison sort
+    std::shuffle(vec.begin(), vec.end(), rng);
+    parallelQuickSortRecursive<uint64_t, std::greater<uint64_t> >(vec);
+    BOOST_CHECK(std::equal(vec.begin(), vec.end(), expected.rbegin()));
+}
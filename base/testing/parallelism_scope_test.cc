@@ -0,0 +1,156 @@
+/** parallelism_scope_test.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test of the limits and priorities of parallel work.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/arch/exception_handler.h"
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+using namespace std;
+using namespace MLDB;
+
+/** Keeps track of the most jobs that ran at once. */
+struct ConcurrencyTracker {
+    std::atomic<int> running{0};
+    std::atomic<int> maxRunning{0};
+
+    void run()
+    {
+        int now = ++running;
+        int prev = maxRunning.load();
+        while (now > prev && !maxRunning.compare_exchange_weak(prev, now)) ;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        --running;
+    }
+};
+
+BOOST_AUTO_TEST_CASE( test_no_scope )
+{
+    BOOST_CHECK_EQUAL(ParallelismScope::maxParallelism(), -1);
+    BOOST_CHECK(ParallelismScope::priority() == ParallelPriority::INTERACTIVE);
+    BOOST_CHECK_EQUAL(ParallelismScope::limit(3), 3);
+    BOOST_CHECK_EQUAL(ParallelismScope::limit(-1), numCpus());
+}
+
+BOOST_AUTO_TEST_CASE( test_scope_nesting )
+{
+    ParallelismScope outer(4, ParallelPriority::BATCH);
+    BOOST_CHECK_EQUAL(ParallelismScope::maxParallelism(), 4);
+    BOOST_CHECK(ParallelismScope::priority() == ParallelPriority::BATCH);
+    BOOST_CHECK_EQUAL(ParallelismScope::limit(-1), std::min(4, numCpus()));
+
+    {
+        // An inner scope can't loosen the limit of the outer one
+        ParallelismScope inner(8);
+        BOOST_CHECK_EQUAL(ParallelismScope::maxParallelism(), 4);
+        BOOST_CHECK(ParallelismScope::priority()
+                    == ParallelPriority::INTERACTIVE);
+        BOOST_CHECK_GE(ParallelismScope::numInteractive(), 1);
+
+        ParallelismScope innermost(2, ParallelPriority::BATCH);
+        BOOST_CHECK_EQUAL(ParallelismScope::maxParallelism(), 2);
+    }
+
+    BOOST_CHECK_EQUAL(ParallelismScope::maxParallelism(), 4);
+    BOOST_CHECK(ParallelismScope::priority() == ParallelPriority::BATCH);
+}
+
+BOOST_AUTO_TEST_CASE( test_single_thread )
+{
+    ParallelismScope scope(1);
+
+    auto id = std::this_thread::get_id();
+    std::atomic<int> otherThread(0);
+
+    parallelMap(0, 1000, [&] (size_t)
+                {
+                    if (std::this_thread::get_id() != id)
+                        ++otherThread;
+                });
+
+    BOOST_CHECK_EQUAL(otherThread.load(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_limit_includes_nested_loops )
+{
+    ConcurrencyTracker tracker;
+
+    {
+        ParallelismScope scope(3);
+        parallelMap(0, 20, [&] (size_t)
+                    {
+                        parallelMap(0, 20, [&] (size_t) { tracker.run(); });
+                    });
+    }
+
+    BOOST_CHECK_LE(tracker.maxRunning.load(), 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_limit_chunked_and_haltable )
+{
+    ConcurrencyTracker tracker;
+    ParallelismScope scope(2);
+
+    parallelMapChunked(0, 1000, 10, [&] (size_t, size_t) { tracker.run(); });
+    BOOST_CHECK_LE(tracker.maxRunning.load(), 2);
+
+    std::atomic<int> done(0);
+    bool finished = parallelMapHaltable(0, 1000, [&] (size_t i)
+                                        {
+                                            tracker.run();
+                                            ++done;
+                                            return i < 50;
+                                        });
+    BOOST_CHECK(!finished);
+    BOOST_CHECK_LT(done.load(), 1000);
+    BOOST_CHECK_LE(tracker.maxRunning.load(), 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_exception_under_limit )
+{
+    MLDB_TRACE_EXCEPTIONS(false);
+    ParallelismScope scope(2, ParallelPriority::BATCH);
+
+    auto doWork = [] (size_t i)
+        {
+            if (i == 10)
+                throw std::logic_error("ten");
+        };
+
+    BOOST_CHECK_THROW(parallelMap(0, 100, doWork), std::logic_error);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_yields_to_interactive )
+{
+    int oldShare = ParallelismScope::batchThreadShare();
+    ParallelismScope::setBatchThreadShare(1);
+
+    ConcurrencyTracker tracker;
+
+    {
+        // While interactive work is running, batch work gets one helper
+        // thread as well as the thread that started it
+        ParallelismScope interactive;
+
+        std::thread batch([&] ()
+            {
+                ParallelismScope scope(-1, ParallelPriority::BATCH);
+                parallelMap(0, 200, [&] (size_t) { tracker.run(); });
+            });
+        batch.join();
+    }
+
+    BOOST_CHECK_LE(tracker.maxRunning.load(), 2);
+
+    ParallelismScope::setBatchThreadShare(oldShare);
+}
@@ -0,0 +1,120 @@
+/** resource_usage_test.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test of resource accounting.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/base/resource_usage.h"
+#include "mldb/base/parallel.h"
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+/// Burn some CPU time in a way the compiler can't remove
+double spin(int n)
+{
+    volatile double x = 0.0;
+    for (int i = 0;  i < n;  ++i)
+        x = x + i * 0.5;
+    return x;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(test_no_current_usage)
+{
+    BOOST_CHECK(ResourceUsage::current() == nullptr);
+
+    // Does nothing without a usage
+    ResourceUsage::countRowScanned("ds");
+}
+
+BOOST_AUTO_TEST_CASE(test_scope)
+{
+    auto usage = std::make_shared<ResourceUsage>("test");
+    BOOST_CHECK_EQUAL(usage->name(), "test");
+    {
+        ResourceUsageScope scope(usage.get());
+        BOOST_CHECK_EQUAL(ResourceUsage::current(), usage.get());
+        for (int i = 0;  i < 10;  ++i)
+            ResourceUsage::countRowScanned("ds1");
+        ResourceUsage::countRowScanned("ds2");
+        usage->addBytesRead("file", 100);
+        usage->addBytesRead("file", 20);
+        spin(10000000);
+    }
+    BOOST_CHECK(ResourceUsage::current() == nullptr);
+
+    auto stats = usage->stats();
+    BOOST_CHECK_GT(stats.cpuSeconds, 0.0);
+    BOOST_CHECK_EQUAL(stats.rowsScanned["ds1"], 10);
+    BOOST_CHECK_EQUAL(stats.rowsScanned["ds2"], 1);
+    BOOST_CHECK_EQUAL(stats.bytesRead["file"], 120);
+}
+
+BOOST_AUTO_TEST_CASE(test_nested_scopes)
+{
+    auto outer = std::make_shared<ResourceUsage>("outer");
+    auto inner = std::make_shared<ResourceUsage>("inner");
+    {
+        ResourceUsageScope outerScope(outer.get());
+        ResourceUsage::countRowScanned("ds");
+        {
+            ResourceUsageScope innerScope(inner.get());
+            BOOST_CHECK_EQUAL(ResourceUsage::current(), inner.get());
+            ResourceUsage::countRowScanned("ds");
+            ResourceUsage::countRowScanned("ds");
+            spin(10000000);
+        }
+        BOOST_CHECK_EQUAL(ResourceUsage::current(), outer.get());
+        ResourceUsage::countRowScanned("ds");
+    }
+
+    // Each row is only counted in its innermost scope
+    BOOST_CHECK_EQUAL(outer->stats().rowsScanned["ds"], 2);
+    BOOST_CHECK_EQUAL(inner->stats().rowsScanned["ds"], 2);
+    BOOST_CHECK_GT(inner->stats().cpuSeconds, 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_map)
+{
+    auto usage = std::make_shared<ResourceUsage>("parallel");
+    {
+        ResourceUsageScope scope(usage.get());
+        std::atomic<int> numInUsage(0);
+        parallelMap(0, 64, [&] (size_t i)
+                    {
+                        numInUsage += ResourceUsage::current() == usage.get();
+                        for (int j = 0;  j < 1000;  ++j)
+                            ResourceUsage::countRowScanned("ds");
+                        spin(100000);
+                    });
+        BOOST_CHECK_EQUAL(numInUsage, 64);
+    }
+
+    auto stats = usage->stats();
+    BOOST_CHECK_EQUAL(stats.rowsScanned["ds"], 64000);
+    BOOST_CHECK_GT(stats.cpuSeconds, 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(test_usage_recreated_at_same_address)
+{
+    // A counter cached by a thread for one usage mustn't be used for a
+    // later one, even if it has the same address
+    for (int i = 0;  i < 3;  ++i) {
+        auto usage = std::make_shared<ResourceUsage>("test");
+        {
+            ResourceUsageScope scope(usage.get());
+            ResourceUsage::countRowScanned("ds");
+        }
+        BOOST_CHECK_EQUAL(usage->stats().rowsScanned["ds"], 1);
+    }
+}
@@ -15,10 +15,13 @@
 #include "mldb/arch/timers.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/base/parallel.h"
+#include "mldb/arch/cpu_info.h"
 
 #include <boost/test/unit_test.hpp>
 #include <atomic>
 #include <thread>
+#include <mutex>
+#include <vector>
 #include <cassert>
 #include <iostream>
 
@@ -227,3 +230,120 @@ BOOST_AUTO_TEST_CASE(threadPoolMultiExceptionCatching)
     BOOST_CHECK_EQUAL(workGroup.jobsFinishedWithException(), 100);
 }
 
+
+BOOST_AUTO_TEST_CASE(parallelMapLocality)
+{
+    auto check = [] (int numNodes)
+        {
+            size_t n = 10000;
+            std::vector<std::atomic<int> > done(n);
+            auto locality = [&] (size_t i) -> int
+                {
+                    // Spread over the nodes, with out of range and no
+                    // preference hints mixed in
+                    if (i % 7 == 0)
+                        return -1;
+                    if (i % 11 == 0)
+                        return numNodes + 3;
+                    return i % numNodes;
+                };
+            parallelMap(0, n, [&] (size_t i) { ++done[i]; }, locality);
+            for (size_t i = 0;  i < n;  ++i)
+                BOOST_CHECK_EQUAL(done[i].load(), 1);
+        };
+
+    CpuTopology saved = cpuTopology();
+
+    // This machine's topology
+    check(saved.numNodes());
+
+    // A fake machine with two nodes, so that the per node queues are used
+    // whatever this machine looks like
+    CpuTopology fake;
+    fake.nodeCpus = { { 0 }, { 1 } };
+    fake.cpuNode = { 0, 1 };
+    setCpuTopology(fake);
+    check(2);
+    setCpuTopology(saved);
+}
+
+BOOST_AUTO_TEST_CASE(threadPoolOverflow)
+{
+    ThreadPool pool(1);
+
+    std::atomic<int> jobsDone(0);
+    int numJobs = 10 * 4096;
+    for (int i = 0;  i < numJobs;  ++i)
+        pool.add([&] () { ++jobsDone; });
+
+    BOOST_CHECK_GT(pool.jobsWithFullQueue(), 0);
+
+    // Don't help: the worker must find the jobs that didn't fit in our
+    // queue by itself
+    while (pool.jobsRunning() > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    BOOST_CHECK_EQUAL(jobsDone.load(), numJobs);
+    BOOST_CHECK_EQUAL(pool.jobsQueued(ParallelPriority::INTERACTIVE), 0);
+}
+
+BOOST_AUTO_TEST_CASE(threadPoolAddRange)
+{
+    ThreadPool pool(4);
+
+    size_t n = 100000;
+    std::vector<std::atomic<int> > done(n);
+    pool.addRange(0, n, [&] (size_t i) { ++done[i]; });
+    pool.addRange(5, 5, [&] (size_t i) { BOOST_FAIL("empty range"); });
+    pool.waitForAll();
+
+    for (size_t i = 0;  i < n;  ++i)
+        BOOST_CHECK_EQUAL(done[i].load(), 1);
+
+    // The range was split into several jobs
+    BOOST_CHECK_GT(pool.jobsSubmitted(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(threadPoolPriorityLanes)
+{
+    ThreadPool pool(1);
+
+    // Keep the only worker busy while the jobs are queued
+    std::atomic<bool> started(false), release(false);
+    pool.add([&] ()
+             {
+                 started = true;
+                 while (!release)
+                     std::this_thread::sleep_for(std::chrono::milliseconds(1));
+             });
+    while (!started)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    std::mutex mutex;
+    std::vector<std::string> order;
+    auto job = [&] (std::string name)
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            order.push_back(name);
+        };
+
+    for (int i = 0;  i < 10;  ++i) {
+        {
+            ParallelismScope scope(-1, ParallelPriority::BATCH);
+            pool.add(job, "batch");
+        }
+        pool.add(job, "interactive");
+    }
+
+    BOOST_CHECK_EQUAL(pool.jobsQueued(ParallelPriority::INTERACTIVE), 10);
+    BOOST_CHECK_EQUAL(pool.jobsQueued(ParallelPriority::BATCH), 10);
+
+    release = true;
+    while (pool.jobsRunning() > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    BOOST_REQUIRE_EQUAL(order.size(), 20);
+    for (int i = 0;  i < 20;  ++i)
+        BOOST_CHECK_EQUAL(order[i], i < 10 ? "interactive" : "batch");
+    BOOST_CHECK_EQUAL(pool.jobsQueued(ParallelPriority::BATCH), 0);
+}
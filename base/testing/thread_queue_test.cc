@@ -19,6 +19,8 @@
 #include <boost/test/unit_test.hpp>
 #include <atomic>
 #include <thread>
+#include <algorithm>
+#include <vector>
 #include <cassert>
 #include <iostream>
 
@@ -417,3 +419,52 @@ BOOST_AUTO_TEST_CASE(PushPopStealWithWraparound) {
     TestPushPopSteal(std::numeric_limits<uint_fast32_t>::max() - 10 /* top and bottom of empty queue */);
 }
 
+
+BOOST_AUTO_TEST_CASE(OverflowQueuePushTakeAll) {
+    OverflowQueue<int> q;
+    BOOST_CHECK(!q.takeAll());
+
+    // Several threads push while another takes everything there is
+    const int numThreads = 4;
+    const int numPerThread = 10000;
+    std::vector<std::atomic<int> > seen(numThreads * numPerThread);
+    std::atomic<int> numPushing(numThreads);
+
+    auto take = [&] ()
+        {
+            OverflowQueue<int>::Node * node = q.takeAll();
+            int lastFromThread[numThreads];
+            std::fill(lastFromThread, lastFromThread + numThreads, -1);
+            while (node) {
+                int value = *node->item;
+                // Each thread's items come out in the order it pushed them
+                BOOST_CHECK_GT(value % numPerThread,
+                               lastFromThread[value / numPerThread]);
+                lastFromThread[value / numPerThread] = value % numPerThread;
+                ++seen[value];
+                OverflowQueue<int>::Node * next = node->next;
+                delete node->item;
+                delete node;
+                node = next;
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (int t = 0;  t < numThreads;  ++t) {
+        threads.emplace_back([&, t] ()
+                             {
+                                 for (int i = 0;  i < numPerThread;  ++i)
+                                     q.push(new int(t * numPerThread + i));
+                                 --numPushing;
+                             });
+    }
+
+    while (numPushing > 0)
+        take();
+    for (auto & t: threads)
+        t.join();
+    take();
+
+    for (auto & s: seen)
+        BOOST_CHECK_EQUAL(s.load(), 1);
+}
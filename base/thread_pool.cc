@@ -11,7 +11,10 @@
 #include "thread_pool_impl.h"
 #include "mldb/arch/thread_specific.h"
 #include "mldb/arch/demangle.h"
+#include "mldb/arch/cpu_info.h"
 #include "mldb/utils/environment.h"
+#include <pthread.h>
+#include <sched.h>
 #include <atomic>
 #include <condition_variable>
 #include <vector>
@@ -32,6 +35,92 @@ int numCpus()
     return NUM_CPUS;
 }
 
+static EnvOption<std::string, true /* trace */>
+THREAD_PINNING("MLDB_THREAD_PINNING", "node");
+
+namespace {
+
+/// Where a worker thread runs
+struct WorkerPlacement {
+    int node = 0;               ///< NUMA node
+    std::vector<int> cpus;      ///< CPUs it's pinned to; empty for none
+};
+
+/** Spread the given number of workers over the NUMA nodes, in proportion
+    to the CPUs that we're allowed to run on in each, by handing out those
+    CPUs alternately from each node.
+*/
+std::vector<WorkerPlacement>
+placeWorkers(int numWorkers, const CpuTopology & topology,
+             const std::string & pinning)
+{
+    std::vector<WorkerPlacement> result(numWorkers);
+    if (pinning != "node" && pinning != "core") {
+        if (pinning != "none")
+            cerr << "MLDB_THREAD_PINNING must be node, core or none; "
+                 << "not pinning" << endl;
+        return result;
+    }
+
+    // Single node machines only get pinned to cores if asked for
+    if (topology.numNodes() == 1 && pinning == "node")
+        return result;
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+        return result;
+
+    std::vector<std::vector<int> > nodeCpus(topology.numNodes());
+    for (int node = 0;  node < topology.numNodes();  ++node) {
+        for (int cpu: topology.nodeCpus[node]) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                nodeCpus[node].push_back(cpu);
+        }
+    }
+
+    std::vector<int> order;
+    for (size_t i = 0;  ;  ++i) {
+        bool any = false;
+        for (auto & cpus: nodeCpus) {
+            if (i < cpus.size()) {
+                order.push_back(cpus[i]);
+                any = true;
+            }
+        }
+        if (!any)
+            break;
+    }
+    if (order.empty())
+        return result;
+
+    for (int i = 0;  i < numWorkers;  ++i) {
+        int cpu = order[i % order.size()];
+        int node = topology.nodeOfCpu(cpu);
+        result[i].node = node;
+        if (pinning == "core")
+            result[i].cpus = { cpu };
+        else result[i].cpus = nodeCpus[node];
+    }
+
+    return result;
+}
+
+/// Pin the calling thread to the given CPUs.  Failures (for example from
+/// a restrictive container) are ignored; the thread simply isn't pinned.
+void pinCurrentThread(const std::vector<int> & cpus)
+{
+    if (cpus.empty())
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu: cpus)
+        CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+} // file scope
+
 /*****************************************************************************/
 /* THREAD POOL                                                               */
 /*****************************************************************************/
@@ -51,9 +140,26 @@ int numCpus()
     threads, but not being able to do much itself.  So the ability to
     handle lots of work being submitted by a given thread but not much being
     done by it is important.
+
+    Jobs that don't fit in the submitting thread's queue go to an unbounded
+    overflow queue, from which idle threads take them.
+
+    The root pool has two lanes: interactive jobs are always run before
+    batch jobs (those submitted under a ParallelismScope with batch
+    priority), so that REST requests and function calls don't wait behind
+    procedures.  Subordinate pools have a single lane, as the jobs that run
+    them on the root pool go into the lane of their priority.
 */
 
 struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
+
+    enum {
+        INTERACTIVE_LANE = 0,
+        BATCH_LANE = 1,   ///< Only in the root pool
+        NUM_LANES = 2
+    };
+
+    typedef OverflowQueue<ThreadJob>::Node OverflowNode;
     
     /// A thread's local copy of the list of queues that may have work in
     /// them, including an epoch number.
@@ -67,14 +173,21 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         /// thread pool's epoch number, we can see if the list is out of
         /// date or not.
         uint64_t epoch;
+
+        /// NUMA node of the thread owning each queue
+        std::vector<int> nodes;
+
+        /// Batch lane queue of each thread; null in subordinate pools
+        std::vector<std::shared_ptr<ThreadQueue<ThreadJob> > > batch;
     };
 
     struct ThreadEntry {
         ThreadEntry(Itl * owner = nullptr, int workerNum = -1)
-            : owner(owner), workerNum(workerNum),
+            : owner(owner), workerNum(workerNum), numaNode(0),
               queue(new ThreadQueue<ThreadJob>()),
               queues(new Queues(0)),
-              lastFound(-1)
+              lastFound(-1),
+              overflow{nullptr, nullptr}
         {
         }
 
@@ -89,6 +202,9 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
             // OK.  But otherwise it should have waited for it
             // to be done.
             owner->unpublishThread(this);
+
+            for (OverflowNode * chain: overflow)
+                OverflowQueue<ThreadJob>::freeChain(chain);
         }
 
         /// The ThreadPool we're owned by
@@ -100,12 +216,20 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         /// don't normally scavenge for work to do.
         int workerNum;
 
+        /// The NUMA node we run on.  Workers are pinned to theirs; for
+        /// other threads it's where they were when they first used the
+        /// pool.
+        int numaNode;
+
         /// Our reference to our work queue.  It's a shared pointer
         /// because others may continue to reference it even after
         /// our thread has been destroyed, and allowing this avoids
         /// a lot of synchronization and locking.
         std::shared_ptr<ThreadQueue<ThreadJob> > queue;
 
+        /// Our batch lane queue, in the root pool only.
+        std::shared_ptr<ThreadQueue<ThreadJob> > batchQueue;
+
         /// The list of queues that we know about over all threads.
         /// This is a cached copy that we occasionally check to see
         /// if it needs to be updated.
@@ -113,6 +237,15 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
 
         /// The last queue number we found work in
         int lastFound;
+
+        /// Jobs we took from the overflow queue of each lane, which are
+        /// moved into our own queue as space becomes available.
+        OverflowNode * overflow[NUM_LANES];
+
+        std::shared_ptr<ThreadQueue<ThreadJob> > & laneQueue(int lane)
+        {
+            return lane == BATCH_LANE ? batchQueue : queue;
+        }
     };
 
     /// This allows us to have one threadEntry per thread
@@ -121,6 +254,12 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     /// Our internal worker threads
     std::vector<std::thread> workers;
 
+    /// Where each of our workers runs
+    std::vector<WorkerPlacement> placements;
+
+    /// Number of NUMA nodes; stealing prefers the local one when above 1
+    int numNodes;
+
     /// Job statistics.  This is designed to allow for a single atomic
     /// access to the full 64 bits to allow determiniation if all
     /// jobs have been terminated at a given point in time.
@@ -128,7 +267,19 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     std::atomic<uint32_t> finished;
 
     /// Statistics counters for debugging and information
-    std::atomic<uint64_t> jobsStolen, jobsWithFullQueue, jobsRunLocally;
+    std::atomic<uint64_t> jobsStolen, jobsStolenRemote, jobsWithFullQueue,
+        jobsRunLocally;
+
+    /// Jobs that didn't fit in their thread's queue, for each lane
+    OverflowQueue<ThreadJob> overflow[NUM_LANES];
+
+    /// Number of jobs in the overflow queues or taken from them but not
+    /// yet moved into a thread's queue, for each lane
+    std::atomic<int64_t> overflowQueued[NUM_LANES];
+
+    /// Number of interactive jobs waiting to run, so that threads in the
+    /// root pool know to look for them before running batch jobs.
+    std::atomic<int64_t> interactiveQueued;
 
     /// Non-zero when we're shutting down.
     std::atomic<int> shutdown;
@@ -210,9 +361,13 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     }
 
     Itl(int numThreads, bool handleExceptions)
-        : jobsStolen(0),
+        : numNodes(cpuTopology().numNodes()),
+          jobsStolen(0),
+          jobsStolenRemote(0),
           jobsWithFullQueue(0),
           jobsRunLocally(0),
+          overflowQueued{0, 0},
+          interactiveQueued(0),
           shutdown(0),
           threadsSleeping(0),
           threadCreationEpoch(0),
@@ -229,6 +384,9 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
 
         if (numThreads == -1)
             numThreads = numCpus();
+
+        placements = placeWorkers(numThreads, cpuTopology(),
+                                  THREAD_PINNING.get());
         
         for (unsigned i = 0;  i < numThreads;  ++i) {
             workers.emplace_back([this, i] () { this->runWorker(i); });
@@ -238,9 +396,13 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     }
 
     Itl(Itl & parent, size_t maxParentJobs, bool handleExceptions)
-        : jobsStolen(0),
+        : numNodes(parent.numNodes),
+          jobsStolen(0),
+          jobsStolenRemote(0),
           jobsWithFullQueue(0),
           jobsRunLocally(0),
+          overflowQueued{0, 0},
+          interactiveQueued(0),
           shutdown(0),
           threadsSleeping(0),
           threadCreationEpoch(0),
@@ -287,6 +449,13 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         if (!threadEntry->owner) {
             threadEntry->owner = this;
             threadEntry->workerNum = workerNum;
+            if (workerNum >= 0 && workerNum < placements.size())
+                threadEntry->numaNode = placements[workerNum].node;
+            else if (numNodes > 1)
+                threadEntry->numaNode = currentNumaNode();
+            if (!parent)
+                threadEntry->batchQueue
+                    = std::make_shared<ThreadQueue<ThreadJob> >();
             publishThread(threadEntry);
         }
 
@@ -303,18 +472,30 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         first call from a given thread to a given thread pool, in which
         case there are locks taken for some of the bookkeeping.
 
-        If this thread's queue is full, then it will run the job
-        immediately to make forward progress and give time to the rest of
-        the system to clear out some work from the queue.
+        If this thread's queue is full, then the job goes to the overflow
+        queue, where an idle thread will pick it up.
     */
     void add(ThreadJob job)
     {
+        int lane = INTERACTIVE_LANE;
+        if (!parent
+            && ParallelismScope::priority() == ParallelPriority::BATCH)
+            lane = BATCH_LANE;
+
         submitted += 1;
+        if (lane == INTERACTIVE_LANE && !parent)
+            ++interactiveQueued;
 
-        std::unique_ptr<ThreadJob> overflow
-            (getEntry().queue->push(new ThreadJob(std::move(job))));
+        ThreadJob * full
+            = getEntry().laneQueue(lane)->push(new ThreadJob(std::move(job)));
 
-        if (!overflow) {
+        if (full) {
+            ++jobsWithFullQueue;
+            ++overflowQueued[lane];
+            overflow[lane].push(full);
+        }
+
+        {
             if (parent) {
                 // If there aren't enough jobs alredy, we submit a new
                 // one.
@@ -355,24 +536,96 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
                 }
             }
         }
-        else {
-            // The queue was full.  Do the work here, hopefully someone
-            // will steal some work in the meantime.
-            ++jobsWithFullQueue;
-            runJob(*overflow);
+    }
+
+    /** Add a job that calls fn for each index in [first, last).  It
+        splits itself in two until it has no more than grainSize indexes,
+        queueing the upper halves for other threads to steal.
+    */
+    void addRange(size_t first, size_t last,
+                  std::shared_ptr<const std::function<void (size_t)> > fn,
+                  size_t grainSize)
+    {
+        add([=] ()
+            {
+                size_t end = last;
+                while (end - first > grainSize) {
+                    size_t mid = first + (end - first) / 2;
+                    addRange(mid, end, fn, grainSize);
+                    end = mid;
+                }
+                for (size_t i = first;  i < end;  ++i)
+                    (*fn)(i);
+            });
+    }
+
+    /** Move the jobs that this thread took from the overflow queue of the
+        given lane into its own queue, as far as they fit.
+    */
+    void refill(ThreadEntry & entry, int lane)
+    {
+        OverflowNode * & chain = entry.overflow[lane];
+        ThreadQueue<ThreadJob> & queue = *entry.laneQueue(lane);
+        while (chain && !queue.push(chain->item)) {
+            OverflowNode * next = chain->next;
+            delete chain;
+            chain = next;
+            --overflowQueued[lane];
         }
     }
 
+    /** Take all of the jobs in the overflow queue of the given lane, and
+        run them.  Returns true if some work was obtained.
+    */
+    bool takeOverflow(ThreadEntry & entry, int lane)
+    {
+        OverflowNode * chain = overflow[lane].takeAll();
+        if (!chain)
+            return false;
+
+        OverflowNode * last = chain;
+        while (last->next)
+            last = last->next;
+        last->next = entry.overflow[lane];
+        entry.overflow[lane] = chain;
+
+        // Make them available for stealing straight away
+        refill(entry, lane);
+        runMine(entry);
+        return true;
+    }
+
     /** Runs as much work as possible in this thread's queue.  Returns
-        true if some work was obtained.
+        true if some work was obtained.  Unless allBatchWork is set, batch
+        jobs are left for later while interactive jobs are waiting.
     */
-    bool runMine(ThreadEntry & entry)
+    bool runMine(ThreadEntry & entry, bool allBatchWork = false)
     {
         bool result = false;
 
-        // First, do all of our work
-        ThreadJob * job;
-        while ((job = entry.queue->pop())) {
+        // First, do all of our interactive work, then our batch work one
+        // job at a time for as long as there is no interactive work
+        // waiting anywhere.
+        for (;;) {
+            if (entry.overflow[INTERACTIVE_LANE])
+                refill(entry, INTERACTIVE_LANE);
+            ThreadJob * job = entry.queue->pop();
+            if (job) {
+                if (!parent)
+                    --interactiveQueued;
+            }
+            else {
+                if (!entry.batchQueue
+                    || (!allBatchWork
+                        && interactiveQueued.load(std::memory_order_relaxed)
+                           > 0))
+                    break;
+                if (entry.overflow[BATCH_LANE])
+                    refill(entry, BATCH_LANE);
+                if (!(job = entry.batchQueue->pop()))
+                    break;
+            }
+
             result = true;
             ++jobsRunLocally;
             runJob(*job);
@@ -387,8 +640,6 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     */
     bool stealWork(ThreadEntry & entry)
     {
-        bool foundWork = false;
-        
         // Check if we have the latest list of queues, by looking at
         // the epoch number.
         if (threadCreationEpoch.load() != entry.queues->epoch) {
@@ -408,39 +659,83 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
             }
         }
 
+        const Queues & queues = *entry.queues;
+
+        if (stealLane(entry, queues, INTERACTIVE_LANE)
+            || takeOverflow(entry, INTERACTIVE_LANE))
+            return true;
+        if (parent)
+            return false;
+        return stealLane(entry, queues, BATCH_LANE)
+            || takeOverflow(entry, BATCH_LANE);
+    }
+
+    /** Steal work from the queues of the given lane of other threads,
+        and run it.  Batch jobs are stolen one at a time, so that
+        interactive jobs that arrive in the meantime are looked for first.
+        Returns true if some work was obtained.
+    */
+    bool stealLane(ThreadEntry & entry, const Queues & queues, int lane)
+    {
+        bool foundWork = false;
+
+        auto isLocal = [&] (int n)
+            {
+                return numNodes == 1 || queues.nodes[n] == entry.numaNode;
+            };
+
         auto stealFrom = [&] (int n)
             {
                 const std::shared_ptr<ThreadQueue<ThreadJob> > & q
-                    = entry.queues->at(n);
+                    = lane == BATCH_LANE ? queues.batch.at(n) : queues.at(n);
+                if (!q || (lane == BATCH_LANE && foundWork))
+                    return;
+                bool remote = !isLocal(n);
                 
                 ThreadJob * job;
                 while ((job = q->steal())) {
                     entry.lastFound = n;
 
                     ++jobsStolen;
+                    if (remote)
+                        ++jobsStolenRemote;
+                    if (lane == INTERACTIVE_LANE && !parent)
+                        --interactiveQueued;
 
                     runJob(*job);
                     foundWork = true;
                     delete job;
                     runMine(entry);
+                    if (lane == BATCH_LANE)
+                        break;
                 }
             };
 
-        size_t nq = entry.queues->size();
+        size_t nq = queues.size();
 
-        if (entry.lastFound > 0 && entry.lastFound < nq) {
+        if (entry.lastFound > 0 && entry.lastFound < nq
+            && isLocal(entry.lastFound)) {
             stealFrom(entry.lastFound);
         }
 
-        for (unsigned i = 0;  i < nq && !shutdown;  ++i) {
-            // Try to avoid all threads starting looking for work at the
-            // same place.
-            int n = entry.lastFound + i;
-            while (n < 0)
-                n += nq;
-            while (n >= nq)
-                n -= nq;
-            stealFrom(n);
+        // On NUMA machines, first look on our own node, and only go to the
+        // other nodes once there is nothing left here.  Remote memory is
+        // slower than waiting a little for work.
+        for (int pass = (numNodes == 1);  pass < 2;  ++pass) {
+            if (pass == 1 && numNodes > 1 && foundWork)
+                break;
+            for (unsigned i = 0;  i < nq && !shutdown;  ++i) {
+                // Try to avoid all threads starting looking for work at the
+                // same place.
+                int n = entry.lastFound + i;
+                while (n < 0)
+                    n += nq;
+                while (n >= nq)
+                    n -= nq;
+                if (pass == 0 && !isLocal(n))
+                    continue;
+                stealFrom(n);
+            }
         }
         
         return foundWork;
@@ -518,6 +813,7 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     /** Run a worker thread. */
     void runWorker(int workerNum)
     {
+        pinCurrentThread(placements.at(workerNum).cpus);
         ThreadEntry & entry = getEntry(workerNum);
 
         int itersWithNoWork = 0;
@@ -602,6 +898,8 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         } while (newQueues->epoch == 0);
 
         newQueues->emplace_back(thread->queue);
+        newQueues->nodes.emplace_back(thread->numaNode);
+        newQueues->batch.emplace_back(thread->batchQueue);
         queues = std::move(newQueues);
     }
 
@@ -615,7 +913,7 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
 
         // Finish all the jobs first, otherwise they will simply
         // disappear.
-        while (runMine(*thread)) ;
+        while (runMine(*thread, true /* allBatchWork */)) ;
 
         ExcAssert(thread);
         std::unique_lock<std::mutex> guard(queuesMutex);
@@ -636,6 +934,10 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         for (auto it = newQueues->begin(), end = newQueues->end();
              !foundThreadToUnpublish && it != end;  ++it) {
             if (*it == thread->queue) {
+                newQueues->nodes.erase(newQueues->nodes.begin()
+                                       + (it - newQueues->begin()));
+                newQueues->batch.erase(newQueues->batch.begin()
+                                       + (it - newQueues->begin()));
                 newQueues->erase(it);
                 foundThreadToUnpublish = true;
             }
@@ -645,14 +947,39 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         queues = std::move(newQueues);
     }
 
+    /** Return the number of jobs of the given lane waiting to be run.
+        This is a snapshot of counters that change as it's read, and so is
+        only approximate while jobs are being added or run.
+    */
+    uint64_t jobsQueued(int lane)
+    {
+        std::shared_ptr<const Queues> current;
+        {
+            std::unique_lock<std::mutex> guard(queuesMutex);
+            current = queues;
+        }
+
+        int64_t result = overflowQueued[lane];
+        for (size_t i = 0;  i < current->size();  ++i) {
+            const std::shared_ptr<ThreadQueue<ThreadJob> > & q
+                = lane == BATCH_LANE ? current->batch[i] : current->at(i);
+            if (q)
+                result += q->num_queued_.load(std::memory_order_relaxed);
+        }
+        return std::max<int64_t>(result, 0);
+    }
+
     void dump()
     {
         cerr << "ThreadPool at " << this << endl;
         cerr << workers.size() << " workers" << endl;
         cerr << "submitted " << submitted << " finished " << finished
              << endl;
-        cerr << "stolen " << jobsStolen << " full " << jobsWithFullQueue
+        cerr << "stolen " << jobsStolen << " remote " << jobsStolenRemote
+             << " full " << jobsWithFullQueue
              << " local " << jobsRunLocally << endl;
+        cerr << "queued interactive " << jobsQueued(INTERACTIVE_LANE)
+             << " batch " << jobsQueued(BATCH_LANE) << endl;
         cerr << "shutdown " << shutdown << endl;
         cerr << "sleeping " << threadsSleeping << endl;
         cerr << "epoch " << threadCreationEpoch << endl;
@@ -689,6 +1016,25 @@ add(ThreadJob job)
     itl->add(std::move(job));
 }
 
+void
+ThreadPool::
+addRange(size_t first, size_t last, std::function<void (size_t)> job,
+         size_t grainSize)
+{
+    ExcAssertLessEqual(first, last);
+    if (first == last)
+        return;
+    if (grainSize == 0) {
+        // Enough pieces that each thread can steal several of them
+        size_t pieces = 8 * std::max<size_t>(1, numCpus());
+        grainSize = std::max<size_t>(1, (last - first) / pieces);
+    }
+    itl->addRange(first, last,
+                  std::make_shared<const std::function<void (size_t)> >
+                      (std::move(job)),
+                  grainSize);
+}
+
 bool
 ThreadPool::
 waitForAll() const
@@ -703,11 +1049,11 @@ hasException() const
     return itl->hasException();
 }
 
-void
+bool
 ThreadPool::
 work() const
 {
-    itl->work();
+    return itl->work();
 }
 
 size_t
@@ -752,6 +1098,13 @@ jobsStolen() const
     return itl->jobsStolen;
 }
 
+uint64_t
+ThreadPool::
+jobsStolenRemote() const
+{
+    return itl->jobsStolenRemote;
+}
+
 uint64_t
 ThreadPool::
 jobsWithFullQueue() const
@@ -766,6 +1119,16 @@ jobsRunLocally() const
     return itl->jobsRunLocally;
 }
 
+uint64_t
+ThreadPool::
+jobsQueued(ParallelPriority priority) const
+{
+    if (priority == ParallelPriority::BATCH && itl->parent)
+        return 0;
+    return itl->jobsQueued(priority == ParallelPriority::BATCH
+                           ? Itl::BATCH_LANE : Itl::INTERACTIVE_LANE);
+}
+
 ThreadPool &
 ThreadPool::
 instance()
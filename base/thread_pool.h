@@ -12,6 +12,7 @@
 
 #include <functional>
 #include <memory>
+#include "mldb/base/parallel.h"
 
 namespace MLDB {
 
@@ -27,6 +28,17 @@ int numCpus();
 
 /** Thread pool abstraction, to allow work to be farmed out over multiple
     threads.
+
+    On machines with more than one NUMA node, the workers of a root pool are
+    spread over the nodes in proportion to their CPUs and pinned to the CPUs
+    of their node, and idle threads steal work from threads on their own
+    node before going to other nodes.  The MLDB_THREAD_PINNING environment
+    variable chooses the pinning: "node" (the default), "core" to pin each
+    worker to a single CPU, or "none".
+
+    Jobs added under a ParallelismScope with batch priority are only run
+    when there are no interactive jobs waiting, so that latency sensitive
+    work isn't held up by procedures.
 */
 
 struct ThreadPool {
@@ -58,6 +70,17 @@ struct ThreadPool {
     */
     void add(ThreadJob job);
     
+    /** Add a job that calls job(i) for each i in [first, last).  Rather
+        than one closure per index, a single job is queued that splits
+        itself in halves, which are stolen by idle threads, until they have
+        at most grainSize indexes.  A grainSize of zero chooses one that
+        gives each thread several pieces.  The same rules about exceptions
+        as for add() apply.
+    */
+    void addRange(size_t first, size_t last,
+                  std::function<void (size_t)> job,
+                  size_t grainSize = 0);
+
     /** Add the given job, automatically binding the given arguments. */
     template<typename Fn, typename Arg0, typename... Args>
     void add(Fn && fn, Arg0 && arg0, Args&&... args)
@@ -101,8 +124,10 @@ struct ThreadPool {
     /** Returns true iff the current thread pool has a pending exception. */
     bool hasException() const;
     
-    /** Lend the calling thread to the thread pool for one job. */
-    void work() const;
+    /** Lend the calling thread to the thread pool for one job.  Returns
+        false if there was no job that it could run.
+    */
+    bool work() const;
 
     size_t numThreads() const;
 
@@ -112,9 +137,17 @@ struct ThreadPool {
     uint64_t jobsFinishedWithException() const;
     
     uint64_t jobsStolen() const;
-    uint64_t jobsWithFullQueue() const;
+    uint64_t jobsStolenRemote() const;  ///< Stolen from another NUMA node
+    uint64_t jobsWithFullQueue() const;  ///< Went to the overflow queue
     uint64_t jobsRunLocally() const;
 
+    /** Number of jobs of the given priority waiting to be run; this is
+        approximate while jobs are being added or run.  Only the root pool
+        has batch jobs; those of subordinate pools are all counted as
+        interactive.
+    */
+    uint64_t jobsQueued(ParallelPriority priority) const;
+
     static ThreadPool & instance();
     
 private:
@@ -127,10 +160,16 @@ private:
 /* THREAD WORK GROUP                                                         */
 /*****************************************************************************/
 
+/** Thread pool for a group of jobs, which runs them on the default thread
+    pool.  The number of jobs run at once is limited to the maximum of the
+    current ParallelismScope.
+*/
 struct ThreadWorkGroup: public ThreadPool {
 
     ThreadWorkGroup(int maxParallelism = -1)
-        : ThreadPool(ThreadPool::instance(), maxParallelism, true /* handle exceptions */)
+        : ThreadPool(ThreadPool::instance(),
+                     ParallelismScope::limit(maxParallelism),
+                     true /* handle exceptions */)
     {
     }
 };
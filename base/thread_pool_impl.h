@@ -138,5 +138,72 @@ struct ThreadQueue {
     }
 };
 
+
+/** Unbounded, lock-free queue that takes the items that don't fit in a
+    ThreadQueue.  Any thread may push; items are taken out all at once,
+    which avoids the ABA problem of popping single items from a lock-free
+    stack.  The thread that takes them feeds them into its own ThreadQueue
+    as space becomes available, from where other threads can steal them.
+*/
+template<typename Item>
+struct OverflowQueue {
+    struct Node {
+        Item * item;
+        Node * next;
+    };
+
+    OverflowQueue()
+        : head_(nullptr)
+    {
+    }
+
+    ~OverflowQueue()
+    {
+        freeChain(head_.load());
+    }
+
+    std::atomic<Node *> head_;
+
+    void push(Item * item)
+    {
+        ExcAssert(item);
+        Node * node = new Node{item, head_.load(std::memory_order_relaxed)};
+        while (!head_.compare_exchange_weak(node->next, node,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed)) ;
+    }
+
+    /** Take every item, returning them as a chain in the order in which
+        they were pushed, or nullptr if there are none.
+    */
+    Node * takeAll()
+    {
+        if (!head_.load(std::memory_order_relaxed))
+            return nullptr;
+        Node * node = head_.exchange(nullptr, std::memory_order_acquire);
+
+        // The stack is newest first; reverse it to run older jobs first
+        Node * result = nullptr;
+        while (node) {
+            Node * next = node->next;
+            node->next = result;
+            result = node;
+            node = next;
+        }
+        return result;
+    }
+
+    /// Delete a chain returned by takeAll(), including its items
+    static void freeChain(Node * node)
+    {
+        while (node) {
+            Node * next = node->next;
+            delete node->item;
+            delete node;
+            node = next;
+        }
+    }
+};
+
 } // namespace MLDB
 
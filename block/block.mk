@@ -5,7 +5,7 @@ LIBBLOCK_SOURCES:= \
 	zip_serializer.cc \
 	file_serializer.cc
 
-$(eval $(call library,block,$(LIBBLOCK_SOURCES),vfs $(LIBARCHIVE_LIB_NAME) types))
+$(eval $(call library,block,$(LIBBLOCK_SOURCES),vfs $(LIBARCHIVE_LIB_NAME) types arch z))
 
 $(eval $(call include_sub_make,testing))
 
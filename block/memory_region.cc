@@ -14,9 +14,11 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/types/path.h"
 #include "mldb/types/basic_value_descriptions.h"
-#include "mldb/arch/vm.h"
+#include "mldb/arch/cpu_info.h"
+#include <atomic>
 
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -78,6 +80,45 @@ range(size_t start, size_t end) const
     return FrozenMemoryRegion(handle_, data() + start, end - start);
 }
 
+void
+FrozenMemoryRegion::
+adviseWillNeed() const
+{
+    if (!data_ || length_ == 0)
+        return;
+
+    // madvise() needs a page aligned start
+    const char * start
+        = (const char *)((size_t)data_ & ~(size_t)page_offset_mask);
+
+    // Only a hint; memory that isn't file-backed will return an error
+    // that we can ignore.
+    madvise((void *)start, data_ + length_ - start, MADV_WILLNEED);
+}
+
+size_t
+FrozenMemoryRegion::
+prefetch() const
+{
+    if (!data_ || length_ == 0)
+        return 0;
+
+    adviseWillNeed();
+
+    const char * start
+        = (const char *)((size_t)data_ & ~(size_t)page_offset_mask);
+    const char * end = data_ + length_;
+
+    // Reading one byte per page brings it in and populates the page tables
+    volatile char sink = 0;
+    for (const char * p = start;  p < end;  p += page_size) {
+        sink = *(p < data_ ? data_ : p);
+    }
+    (void)sink;
+
+    return length_;
+}
+
 #if 0
 void
 FrozenMemoryRegion::
@@ -206,16 +247,213 @@ mapFile(const Url & filename, size_t startOffset, ssize_t length)
 }
 
 
+/*****************************************************************************/
+/* MEMORY ALLOCATION POLICY                                                  */
+/*****************************************************************************/
+
+DEFINE_ENUM_DESCRIPTION(MemoryHugePages);
+
+MemoryHugePagesDescription::
+MemoryHugePagesDescription()
+{
+    addValue("none", HUGE_PAGES_NONE, "Normal pages");
+    addValue("transparent", HUGE_PAGES_TRANSPARENT,
+             "Transparent huge pages, requested with madvise()");
+    addValue("2M", HUGE_PAGES_2M,
+             "2MB pages from the hugetlbfs pool, falling back to "
+             "transparent huge pages when none are available");
+    addValue("1G", HUGE_PAGES_1G,
+             "1GB pages from the hugetlbfs pool, falling back to 2MB pages "
+             "then transparent huge pages when none are available");
+}
+
+DEFINE_ENUM_DESCRIPTION(MemoryNumaPlacement);
+
+MemoryNumaPlacementDescription::
+MemoryNumaPlacementDescription()
+{
+    addValue("default", NUMA_PLACEMENT_DEFAULT,
+             "Pages are placed on the node that first touches them");
+    addValue("interleave", NUMA_PLACEMENT_INTERLEAVE,
+             "Pages are spread evenly over all of the nodes");
+    addValue("bind", NUMA_PLACEMENT_BIND,
+             "Pages are all placed on the node given by numaNode");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(MemoryAllocationPolicy);
+
+MemoryAllocationPolicyDescription::
+MemoryAllocationPolicyDescription()
+{
+    MemoryAllocationPolicy defaults;
+    nullAccepted = true;
+
+    addField("alignment", &MemoryAllocationPolicy::alignment,
+             "Minimum alignment in bytes of every region.  It must be a "
+             "power of two.  The default of a cache line is enough for any "
+             "SIMD instruction.", defaults.alignment);
+    addField("hugePages", &MemoryAllocationPolicy::hugePages,
+             "Kind of pages used for regions of at least `pageThreshold` "
+             "bytes.  Huge pages reduce TLB misses when large columns are "
+             "accessed randomly.", defaults.hugePages);
+    addField("pageThreshold", &MemoryAllocationPolicy::pageThreshold,
+             "Regions of at least this many bytes are mapped directly as "
+             "pages, to which the `hugePages` and `numaPlacement` policies "
+             "apply.  Smaller regions are allocated from the heap.",
+             defaults.pageThreshold);
+    addField("numaPlacement", &MemoryAllocationPolicy::numaPlacement,
+             "NUMA placement of regions of at least `pageThreshold` bytes.",
+             defaults.numaPlacement);
+    addField("numaNode", &MemoryAllocationPolicy::numaNode,
+             "Node to place regions on when `numaPlacement` is `bind`.",
+             defaults.numaNode);
+
+    onPostValidate = [] (MemoryAllocationPolicy * policy, JsonParsingContext &)
+        {
+            if (policy->alignment == 0
+                || (policy->alignment & (policy->alignment - 1)) != 0) {
+                throw AnnotatedException(400, "Memory allocation alignment "
+                                         "must be a power of two",
+                                         "alignment", policy->alignment);
+            }
+        };
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(MemoryAllocationStats);
+
+MemoryAllocationStatsDescription::
+MemoryAllocationStatsDescription()
+{
+    addField("policy", &MemoryAllocationStats::policy,
+             "Allocation policy that was asked for");
+    addField("heapRegions", &MemoryAllocationStats::heapRegions,
+             "Number of regions allocated from the heap");
+    addField("heapBytes", &MemoryAllocationStats::heapBytes,
+             "Bytes in regions allocated from the heap");
+    addField("pageRegions", &MemoryAllocationStats::pageRegions,
+             "Number of regions mapped with normal pages");
+    addField("pageBytes", &MemoryAllocationStats::pageBytes,
+             "Bytes in regions mapped with normal pages");
+    addField("transparentHugePageRegions",
+             &MemoryAllocationStats::transparentHugePageRegions,
+             "Number of regions mapped with transparent huge pages");
+    addField("transparentHugePageBytes",
+             &MemoryAllocationStats::transparentHugePageBytes,
+             "Bytes in regions mapped with transparent huge pages");
+    addField("hugePage2MRegions", &MemoryAllocationStats::hugePage2MRegions,
+             "Number of regions mapped with 2MB pages from the pool");
+    addField("hugePage2MBytes", &MemoryAllocationStats::hugePage2MBytes,
+             "Bytes in regions mapped with 2MB pages from the pool");
+    addField("hugePage1GRegions", &MemoryAllocationStats::hugePage1GRegions,
+             "Number of regions mapped with 1GB pages from the pool");
+    addField("hugePage1GBytes", &MemoryAllocationStats::hugePage1GBytes,
+             "Bytes in regions mapped with 1GB pages from the pool");
+    addField("hugePageFallbacks", &MemoryAllocationStats::hugePageFallbacks,
+             "Number of times that the huge page pool had no pages of the "
+             "requested size, and smaller pages were used instead");
+    addField("numaRegions", &MemoryAllocationStats::numaRegions,
+             "Number of regions placed according to the NUMA policy");
+    addField("numaFailures", &MemoryAllocationStats::numaFailures,
+             "Number of regions that couldn't be placed according to the "
+             "NUMA policy");
+}
+
+
 /*****************************************************************************/
 /* MEMORY SERIALIZER                                                         */
 /*****************************************************************************/
 
+namespace {
+
+// From <linux/mempolicy.h>, which we don't want to depend on
+enum {
+    MPOL_BIND_MODE = 2,
+    MPOL_INTERLEAVE_MODE = 3
+};
+
+#ifndef MAP_HUGE_SHIFT
+#  define MAP_HUGE_SHIFT 26
+#endif
+
+/** Deleter of a region that was mapped directly as pages.  The freeze()
+    method finds it with std::get_deleter() to protect the whole mapping,
+    which can't be done piecewise for huge pages.
+*/
+struct PageMapping {
+    void * start;
+    size_t length;
+
+    void operator () (void * mem) const
+    {
+        munmap(start, length);
+    }
+};
+
+// Map anonymous memory with the given flags, or return null
+void * mapAnonymous(size_t length, int flags)
+{
+    void * result = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return result == MAP_FAILED ? nullptr : result;
+}
+
+size_t roundUp(size_t n, size_t multiple)
+{
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+} // file scope
+
+struct MemorySerializer::Stats {
+    std::atomic<uint64_t> heapRegions{0}, heapBytes{0};
+    std::atomic<uint64_t> pageRegions{0}, pageBytes{0};
+    std::atomic<uint64_t> transparentRegions{0}, transparentBytes{0};
+    std::atomic<uint64_t> huge2MRegions{0}, huge2MBytes{0};
+    std::atomic<uint64_t> huge1GRegions{0}, huge1GBytes{0};
+    std::atomic<uint64_t> hugePageFallbacks{0};
+    std::atomic<uint64_t> numaRegions{0}, numaFailures{0};
+};
+
+MemorySerializer::
+MemorySerializer(MemoryAllocationPolicy policy)
+    : policy_(std::move(policy)), stats_(new Stats())
+{
+    ExcAssertEqual((policy_.alignment & (policy_.alignment - 1)), 0);
+}
+
+MemorySerializer::
+~MemorySerializer()
+{
+}
+
 void
 MemorySerializer::
 commit()
 {
 }
 
+MemoryAllocationStats
+MemorySerializer::
+getStats() const
+{
+    MemoryAllocationStats result;
+    result.policy = policy_;
+    result.heapRegions = stats_->heapRegions;
+    result.heapBytes = stats_->heapBytes;
+    result.pageRegions = stats_->pageRegions;
+    result.pageBytes = stats_->pageBytes;
+    result.transparentHugePageRegions = stats_->transparentRegions;
+    result.transparentHugePageBytes = stats_->transparentBytes;
+    result.hugePage2MRegions = stats_->huge2MRegions;
+    result.hugePage2MBytes = stats_->huge2MBytes;
+    result.hugePage1GRegions = stats_->huge1GRegions;
+    result.hugePage1GBytes = stats_->huge1GBytes;
+    result.hugePageFallbacks = stats_->hugePageFallbacks;
+    result.numaRegions = stats_->numaRegions;
+    result.numaFailures = stats_->numaFailures;
+    return result;
+}
+
 // Return the set of pages that are completely covered by this memory block
 static std::pair<void *, size_t>
 getPageRange(const void * mem, size_t length)
@@ -234,6 +472,129 @@ getPageRange(const void * mem, size_t length)
     return { startAddr, pageLen };
 }
 
+MutableMemoryRegion
+MemorySerializer::
+allocatePages(uint64_t bytesRequired, size_t alignment)
+{
+    static constexpr size_t HUGE_2M = 1ULL << 21;
+    static constexpr size_t HUGE_1G = 1ULL << 30;
+
+    void * start = nullptr;
+    size_t length = 0;
+
+    // Explicit huge pages come from the pool, and the mapping must be a
+    // whole number of them.  When the pool is empty, fall back to the
+    // next size down.
+    MemoryHugePages pages = policy_.hugePages;
+    if (pages == HUGE_PAGES_1G && alignment <= HUGE_1G) {
+        length = roundUp(bytesRequired, HUGE_1G);
+        start = mapAnonymous(length, MAP_HUGETLB | (30 << MAP_HUGE_SHIFT));
+        if (start) {
+            stats_->huge1GRegions += 1;
+            stats_->huge1GBytes += length;
+        }
+        else {
+            stats_->hugePageFallbacks += 1;
+            pages = HUGE_PAGES_2M;
+        }
+    }
+    if (!start && pages == HUGE_PAGES_2M && alignment <= HUGE_2M) {
+        length = roundUp(bytesRequired, HUGE_2M);
+        start = mapAnonymous(length, MAP_HUGETLB | (21 << MAP_HUGE_SHIFT));
+        if (start) {
+            stats_->huge2MRegions += 1;
+            stats_->huge2MBytes += length;
+        }
+        else {
+            stats_->hugePageFallbacks += 1;
+            pages = HUGE_PAGES_TRANSPARENT;
+        }
+    }
+
+    char * data = (char *)start;
+
+    if (!start) {
+        // Normal pages.  For transparent huge pages, the region needs to
+        // start on a huge page boundary for the kernel to use them, so we
+        // map extra and trim it off.
+        size_t align = std::max<size_t>(alignment, page_size);
+        if (pages != HUGE_PAGES_NONE)
+            align = std::max(align, HUGE_2M);
+
+        length = roundUp(bytesRequired, page_size);
+        size_t mappedLength = length + align - page_size;
+        char * mapped = (char *)mapAnonymous(mappedLength, 0);
+        if (!mapped) {
+            throw AnnotatedException(400, "Error mapping writable memory: "
+                                     + string(strerror(errno)),
+                                     "bytesRequired", bytesRequired,
+                                     "alignment", alignment);
+        }
+
+        data = (char *)roundUp((size_t)mapped, align);
+        if (data != mapped)
+            munmap(mapped, data - mapped);
+        if (data + length != mapped + mappedLength)
+            munmap(data + length, mapped + mappedLength - (data + length));
+        start = data;
+
+        if (pages != HUGE_PAGES_NONE) {
+            madvise(start, length, MADV_HUGEPAGE);
+            stats_->transparentRegions += 1;
+            stats_->transparentBytes += length;
+        }
+        else {
+            stats_->pageRegions += 1;
+            stats_->pageBytes += length;
+        }
+    }
+
+    std::shared_ptr<void> handle(start, PageMapping{start, length});
+
+    // Place the pages before they are touched
+    if (policy_.numaPlacement != NUMA_PLACEMENT_DEFAULT) {
+        const CpuTopology & topology = cpuTopology();
+        std::vector<unsigned long> nodeMask(1);
+        int mode = MPOL_INTERLEAVE_MODE;
+
+        auto addNode = [&] (int node)
+            {
+                size_t bits = 8 * sizeof(unsigned long);
+                if (node / bits >= nodeMask.size())
+                    nodeMask.resize(node / bits + 1);
+                nodeMask[node / bits] |= 1UL << (node % bits);
+            };
+
+        bool valid = true;
+        if (policy_.numaPlacement == NUMA_PLACEMENT_BIND) {
+            mode = MPOL_BIND_MODE;
+            valid = policy_.numaNode >= 0
+                && policy_.numaNode < topology.numNodes();
+            if (valid)
+                addNode(policy_.numaNode);
+        }
+        else {
+            for (int node = 0;  node < topology.numNodes();  ++node)
+                addNode(node);
+        }
+
+        bool placed = false;
+        if (valid && topology.numNodes() > 1) {
+            long res = syscall(SYS_mbind, start, length, mode,
+                               nodeMask.data(),
+                               nodeMask.size() * 8 * sizeof(unsigned long),
+                               0 /* flags */);
+            placed = res == 0;
+        }
+
+        if (placed)
+            stats_->numaRegions += 1;
+        else stats_->numaFailures += 1;
+    }
+
+    return { std::move(handle), data, (size_t)bytesRequired, this };
+}
+
 MutableMemoryRegion
 MemorySerializer::
 allocateWritable(uint64_t bytesRequired,
@@ -241,8 +602,13 @@ allocateWritable(uint64_t bytesRequired,
 {
     //cerr << "allocating " << bytesRequired << " bytes" << endl;
         
-    void * mem = nullptr;
     ExcAssertEqual((size_t)bytesRequired, bytesRequired);
+    alignment = std::max<size_t>(alignment, policy_.alignment);
+
+    if (policy_.mapsPages() && bytesRequired >= policy_.pageThreshold)
+        return allocatePages(bytesRequired, alignment);
+
+    void * mem = nullptr;
     if (alignment < sizeof(void *)) {
         alignment = sizeof(void *);
     }
@@ -256,6 +622,9 @@ allocateWritable(uint64_t bytesRequired,
                                   "alignment", alignment);
     }
 
+    stats_->heapRegions += 1;
+    stats_->heapBytes += bytesRequired;
+
     std::shared_ptr<void> handle(mem, [] (void * mem) { ::free(mem); });
     return {std::move(handle), (char *)mem, (size_t)bytesRequired, this };
 }
@@ -269,7 +638,19 @@ freeze(MutableMemoryRegion & region)
 
     void * pageStart;
     size_t pageLen;
-    std::tie(pageStart, pageLen) = getPageRange(data, length);
+
+    // Regions mapped as pages own their whole mapping, which is protected
+    // in one piece so that huge pages aren't split (or, for those from the
+    // pool, so that the protection is a whole number of pages).
+    std::shared_ptr<const void> regionHandle = region.handle();
+    if (auto mapping = std::get_deleter<PageMapping>(regionHandle)) {
+        pageStart = mapping->start;
+        pageLen = mapping->length;
+    }
+    else {
+        std::tie(pageStart, pageLen) = getPageRange(data, length);
+    }
+    regionHandle.reset();
 
     std::shared_ptr<const void> handle;
     
@@ -333,7 +714,7 @@ newObject(const PathElement & name,
         desc.printJson(val, context);
     }
     //cerr << "doing metadata " << printed << endl;
-    auto entry = newEntry("md");
+    auto entry = newEntry(name);
     auto serializeTo = entry->allocateWritable(printed.rawLength(),
                                                1 /* alignment */);
     
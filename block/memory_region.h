@@ -61,6 +61,19 @@ struct FrozenMemoryRegion {
         range of the current one.
     */
     FrozenMemoryRegion range(size_t start, size_t end) const;
+
+    /** Make sure the pages of the region are in memory, so that later
+        accesses don't need to wait for them to be paged in.  For a memory
+        mapped file, this asks the kernel to read ahead and then touches
+        each page.  Returns the number of bytes touched.
+    */
+    size_t prefetch() const;
+
+    /** Tell the kernel that the region will be needed soon, so that it
+        can start reading it in asynchronously.  This is only a hint, and
+        does nothing for memory that isn't mapped from a file.
+    */
+    void adviseWillNeed() const;
     
 #if 0
     /** Re-serialize the block to the other serializer. */
@@ -290,6 +303,82 @@ struct MappedSerializer {
 };
 
 
+/*****************************************************************************/
+/* MEMORY ALLOCATION POLICY                                                  */
+/*****************************************************************************/
+
+/** Kind of pages used for large memory regions. */
+enum MemoryHugePages {
+    HUGE_PAGES_NONE,          ///< Normal pages
+    HUGE_PAGES_TRANSPARENT,   ///< Transparent huge pages, with madvise()
+    HUGE_PAGES_2M,            ///< 2MB pages from the hugetlbfs pool
+    HUGE_PAGES_1G             ///< 1GB pages from the hugetlbfs pool
+};
+
+DECLARE_ENUM_DESCRIPTION(MemoryHugePages);
+
+/** NUMA placement of large memory regions. */
+enum MemoryNumaPlacement {
+    NUMA_PLACEMENT_DEFAULT,     ///< Wherever the kernel puts it (first touch)
+    NUMA_PLACEMENT_INTERLEAVE,  ///< Pages spread over all of the nodes
+    NUMA_PLACEMENT_BIND         ///< All pages on a single node
+};
+
+DECLARE_ENUM_DESCRIPTION(MemoryNumaPlacement);
+
+/** How a MemorySerializer allocates its regions.  Regions of at least
+    pageThreshold bytes are mapped directly as pages, and the huge page and
+    NUMA policies apply to them; smaller regions come from the heap.  Huge
+    pages from the hugetlbfs pool fall back to transparent huge pages when
+    the pool is exhausted, and NUMA placement is skipped when it fails or
+    the machine has a single node; both are counted in the stats.
+*/
+struct MemoryAllocationPolicy {
+    /// Minimum alignment of every region, on top of what's asked for.  The
+    /// default is a cache line, which is enough for any SIMD loads.
+    uint64_t alignment = 64;
+
+    MemoryHugePages hugePages = HUGE_PAGES_NONE;
+
+    /// Regions of at least this many bytes are mapped as pages
+    uint64_t pageThreshold = 2 * 1024 * 1024;
+
+    MemoryNumaPlacement numaPlacement = NUMA_PLACEMENT_DEFAULT;
+
+    /// Node to bind to for NUMA_PLACEMENT_BIND
+    int numaNode = 0;
+
+    /// Does any region get mapped as pages rather than coming from the heap?
+    bool mapsPages() const
+    {
+        return hugePages != HUGE_PAGES_NONE
+            || numaPlacement != NUMA_PLACEMENT_DEFAULT;
+    }
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(MemoryAllocationPolicy);
+
+/** What a MemorySerializer allocated, and how. */
+struct MemoryAllocationStats {
+    MemoryAllocationPolicy policy;     ///< Policy that was asked for
+    uint64_t heapRegions = 0;          ///< Regions allocated from the heap
+    uint64_t heapBytes = 0;
+    uint64_t pageRegions = 0;          ///< Regions mapped with normal pages
+    uint64_t pageBytes = 0;
+    uint64_t transparentHugePageRegions = 0;
+    uint64_t transparentHugePageBytes = 0;
+    uint64_t hugePage2MRegions = 0;    ///< Regions from the 2MB page pool
+    uint64_t hugePage2MBytes = 0;
+    uint64_t hugePage1GRegions = 0;    ///< Regions from the 1GB page pool
+    uint64_t hugePage1GBytes = 0;
+    uint64_t hugePageFallbacks = 0;    ///< Pool exhausted; smaller pages used
+    uint64_t numaRegions = 0;          ///< Regions with NUMA placement
+    uint64_t numaFailures = 0;         ///< Placement asked for but not done
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(MemoryAllocationStats);
+
+
 /*****************************************************************************/
 /* MEMORY SERIALIZER                                                         */
 /*****************************************************************************/
@@ -297,9 +386,9 @@ struct MappedSerializer {
 /** Mapped serializer that puts things in memory. */
 
 struct MemorySerializer: public MappedSerializer {
-    virtual ~MemorySerializer()
-    {
-    }
+    MemorySerializer(MemoryAllocationPolicy policy = MemoryAllocationPolicy());
+
+    virtual ~MemorySerializer();
 
     virtual void commit();
 
@@ -308,6 +397,24 @@ struct MemorySerializer: public MappedSerializer {
     virtual MutableMemoryRegion
     allocateWritable(uint64_t bytesRequired,
                      size_t alignment);
+
+    const MemoryAllocationPolicy & policy() const
+    {
+        return policy_;
+    }
+
+    /// Return what has been allocated so far
+    MemoryAllocationStats getStats() const;
+
+private:
+    MemoryAllocationPolicy policy_;
+
+    struct Stats;
+    std::unique_ptr<Stats> stats_;
+
+    /// Map a region directly as pages, according to the policy
+    MutableMemoryRegion
+    allocatePages(uint64_t bytesRequired, size_t alignment);
 };
 
 
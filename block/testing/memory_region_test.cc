@@ -0,0 +1,122 @@
+/** memory_region_test.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test of memory region allocation policies.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/block/memory_region.h"
+#include "mldb/types/value_description.h"
+#include "mldb/arch/exception_handler.h"
+#include <cstring>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+/** Allocate, fill and freeze a region of the given size, and check that
+    it's aligned and reads back what was written.
+*/
+FrozenMemoryRegion fillAndFreeze(MemorySerializer & serializer, size_t size,
+                                 size_t alignment = 1)
+{
+    auto region = serializer.allocateWritable(size, alignment);
+    BOOST_CHECK_EQUAL(region.length(), size);
+    BOOST_CHECK_EQUAL((size_t)region.data() % serializer.policy().alignment, 0);
+    BOOST_CHECK_EQUAL((size_t)region.data() % alignment, 0);
+    for (size_t i = 0;  i < size;  ++i)
+        region.data()[i] = i % 251;
+
+    FrozenMemoryRegion frozen = region.freeze();
+    BOOST_REQUIRE_EQUAL(frozen.length(), size);
+    for (size_t i = 0;  i < size;  i += 4093)
+        BOOST_CHECK_EQUAL(frozen.data()[i], (char)(i % 251));
+    return frozen;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_default_policy )
+{
+    MemorySerializer serializer;
+    fillAndFreeze(serializer, 10);
+    fillAndFreeze(serializer, 3 << 20, 16);
+
+    // Everything comes from the heap, aligned to a cache line
+    MemoryAllocationStats stats = serializer.getStats();
+    BOOST_CHECK_EQUAL(stats.heapRegions, 2);
+    BOOST_CHECK_EQUAL(stats.heapBytes, 10 + (3 << 20));
+    BOOST_CHECK_EQUAL(stats.pageRegions, 0);
+    BOOST_CHECK_EQUAL(stats.transparentHugePageRegions, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_transparent_huge_pages )
+{
+    MemoryAllocationPolicy policy;
+    policy.hugePages = HUGE_PAGES_TRANSPARENT;
+    policy.pageThreshold = 1 << 20;
+    MemorySerializer serializer(policy);
+
+    fillAndFreeze(serializer, 1000);
+    auto frozen = fillAndFreeze(serializer, (3 << 20) + 17);
+
+    // Mapped regions start on a huge page boundary
+    BOOST_CHECK_EQUAL((size_t)frozen.data() % (2 << 20), 0);
+
+    MemoryAllocationStats stats = serializer.getStats();
+    BOOST_CHECK_EQUAL(stats.heapRegions, 1);
+    BOOST_CHECK_EQUAL(stats.transparentHugePageRegions, 1);
+    BOOST_CHECK_GE(stats.transparentHugePageBytes, (3 << 20) + 17);
+}
+
+BOOST_AUTO_TEST_CASE( test_explicit_huge_pages )
+{
+    MemoryAllocationPolicy policy;
+    policy.hugePages = HUGE_PAGES_2M;
+    MemorySerializer serializer(policy);
+
+    // Works whether or not the machine has a pool of huge pages; when it
+    // doesn't, transparent huge pages are used instead.
+    fillAndFreeze(serializer, 5 << 20);
+
+    MemoryAllocationStats stats = serializer.getStats();
+    BOOST_CHECK_EQUAL(stats.hugePage2MRegions
+                      + stats.transparentHugePageRegions, 1);
+    BOOST_CHECK_EQUAL(stats.hugePageFallbacks,
+                      stats.transparentHugePageRegions);
+    if (stats.hugePage2MRegions)
+        BOOST_CHECK_EQUAL(stats.hugePage2MBytes, 6 << 20);
+}
+
+BOOST_AUTO_TEST_CASE( test_numa_placement )
+{
+    MemoryAllocationPolicy policy;
+    policy.numaPlacement = NUMA_PLACEMENT_INTERLEAVE;
+    MemorySerializer serializer(policy);
+
+    fillAndFreeze(serializer, 4 << 20);
+
+    // A single node machine can't interleave, which is counted as a
+    // failure rather than an error
+    MemoryAllocationStats stats = serializer.getStats();
+    BOOST_CHECK_EQUAL(stats.pageRegions, 1);
+    BOOST_CHECK_EQUAL(stats.numaRegions + stats.numaFailures, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_policy_description )
+{
+    auto policy = jsonDecodeStr<MemoryAllocationPolicy>
+        (string("{\"hugePages\":\"transparent\",\"alignment\":128}"));
+    BOOST_CHECK_EQUAL(policy.hugePages, HUGE_PAGES_TRANSPARENT);
+    BOOST_CHECK_EQUAL(policy.alignment, 128);
+    BOOST_CHECK_EQUAL(policy.numaPlacement, NUMA_PLACEMENT_DEFAULT);
+
+    MLDB_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(jsonDecodeStr<MemoryAllocationPolicy>
+                      (string("{\"alignment\":48}")), std::exception);
+}
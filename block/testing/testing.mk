@@ -1 +1,4 @@
 # This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
+
+$(eval $(call test,memory_region_test,block arch types,boost))
+$(eval $(call test,zip_serializer_test,block arch types vfs,boost))
@@ -0,0 +1,97 @@
+/** zip_serializer_test.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test of writing zip files, including from several threads at once.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/block/zip_serializer.h"
+#include "mldb/types/url.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include <thread>
+#include <cstring>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+/** Entry i of thread t; a few are big enough to be written with direct
+    I/O.
+*/
+FrozenMemoryRegion makeEntry(MemorySerializer & serializer, int t, int i)
+{
+    size_t size = i % 8 == 3 ? 5 * 1024 * 1024 + i : i * 100 + t;
+    auto region = serializer.allocateWritable(size, 1);
+    for (size_t j = 0;  j < size;  ++j)
+        region.data()[j] = (j * 31 + t + i) % 251;
+    return region.freeze();
+}
+
+void checkEntry(const FrozenMemoryRegion & region, int t, int i)
+{
+    size_t size = i % 8 == 3 ? 5 * 1024 * 1024 + i : i * 100 + t;
+    BOOST_REQUIRE_EQUAL(region.length(), size);
+    for (size_t j = 0;  j < size;  ++j) {
+        if (region.data()[j] != (char)((j * 31 + t + i) % 251)) {
+            BOOST_CHECK_EQUAL(region.data()[j], (char)((j * 31 + t + i) % 251));
+            break;
+        }
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_concurrent_entries )
+{
+    std::string filename = "tmp/zip_serializer_test.zip";
+    int numThreads = 8, numEntries = 20;
+
+    {
+        MemorySerializer memory;
+        ZipStructuredSerializer serializer(filename);
+
+        std::vector<std::thread> threads;
+        for (int t = 0;  t < numThreads;  ++t) {
+            auto onThread = [&, t] ()
+                {
+                    auto structure = serializer.newStructure(to_string(t));
+                    for (int i = 0;  i < numEntries;  ++i) {
+                        structure->addRegion(makeEntry(memory, t, i),
+                                             to_string(i));
+                    }
+                    structure->commit();
+                };
+            threads.emplace_back(onThread);
+        }
+        for (auto & t: threads)
+            t.join();
+
+        serializer.newObject("md.json", std::string("hello"));
+        serializer.commit();
+    }
+
+    ZipStructuredReconstituter reconstituter(Url("file://" + filename));
+    BOOST_CHECK_EQUAL(reconstituter.getDirectory().size(), numThreads + 1);
+
+    for (int t = 0;  t < numThreads;  ++t) {
+        auto structure = reconstituter.getStructure(to_string(t));
+        BOOST_CHECK_EQUAL(structure->getDirectory().size(), numEntries);
+        for (int i = 0;  i < numEntries;  ++i) {
+            FrozenMemoryRegion region = structure->getRegion(to_string(i));
+            checkEntry(region, t, i);
+
+            // Large entries are aligned in the file for direct I/O, and so
+            // can be used in place
+            if (region.length() >= 4 * 1024 * 1024)
+                BOOST_CHECK_EQUAL((size_t)region.data() % 4096, 0);
+        }
+    }
+
+    FrozenMemoryRegion md = reconstituter.getRegion("md.json");
+    BOOST_CHECK_EQUAL(string(md.data(), md.length()), "\"hello\"");
+}
@@ -10,6 +10,15 @@
 #include "types/annotated_exception.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/arch/timers.h"
+#include <zlib.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
 
 // libarchive support
 #include "mldb/ext/libarchive/libarchive/archive.h"
@@ -37,142 +46,441 @@ struct ZipStructuredSerializer::Itl {
     virtual BaseItl * base() const = 0;
 };
 
+namespace {
+
+/// Entries at least this big have their data aligned in the file and are
+/// written with direct I/O, bypassing the page cache
+static constexpr size_t DIRECT_IO_THRESHOLD = 4 * 1024 * 1024;
+
+/// Alignment of the file offset, length and memory for direct I/O
+static constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+
+/// Size of the buffer used to align data for direct I/O
+static constexpr size_t DIRECT_IO_BUFFER = 8 * 1024 * 1024;
+
+/// Extra field used to pad local headers so that the data is aligned.  This
+/// is the same one that Android's zipalign uses.
+static constexpr uint16_t ZIP_PADDING_EXTRA_ID = 0xd935;
+
+/// Values at least this big need the zip64 extensions
+static constexpr uint64_t ZIP64_LIMIT = 0xffffffff;
+
+template<typename Int>
+void appendLE(std::string & out, Int val)
+{
+    for (size_t i = 0;  i < sizeof(Int);  ++i)
+        out.push_back((char)((uint64_t)val >> (8 * i)));
+}
+
+uint32_t zipCrc32(const char * data, uint64_t length)
+{
+    uLong result = crc32(0L, Z_NULL, 0);
+    while (length > 0) {
+        uInt n = std::min<uint64_t>(length, 1 << 30);
+        result = crc32(result, (const Bytef *)data, n);
+        data += n;
+        length -= n;
+    }
+    return result;
+}
+
+/** An entry of a zip file that has been (or is being) written, which is
+    everything that's needed for its central directory record.
+*/
+struct ZipEntryInfo {
+    std::string name;
+    uint64_t headerOffset = 0;
+    uint64_t length = 0;
+    uint32_t crc = 0;
+};
+
+/** Number of padding bytes to add to the local header of the entry so that
+    its data starts on an alignment boundary.  The padding is an extra
+    field, so it's either zero or at least 4 bytes long.
+*/
+size_t zipPadding(const ZipEntryInfo & entry, size_t alignment)
+{
+    uint64_t dataOffset = entry.headerOffset + 30 + entry.name.size()
+        + (entry.length >= ZIP64_LIMIT ? 20 : 0);
+    size_t result = (alignment - dataOffset % alignment) % alignment;
+    if (result > 0 && result < 4)
+        result += alignment;
+    return result;
+}
+
+std::string zipLocalHeader(const ZipEntryInfo & entry, size_t padding,
+                           uint16_t dosTime, uint16_t dosDate)
+{
+    bool zip64 = entry.length >= ZIP64_LIMIT;
+    uint32_t length32 = zip64 ? ZIP64_LIMIT : entry.length;
+
+    std::string result;
+    appendLE<uint32_t>(result, 0x04034b50);
+    appendLE<uint16_t>(result, zip64 ? 45 : 20);  // version needed
+    appendLE<uint16_t>(result, 0x0800);           // UTF-8 name
+    appendLE<uint16_t>(result, 0);                // stored
+    appendLE<uint16_t>(result, dosTime);
+    appendLE<uint16_t>(result, dosDate);
+    appendLE<uint32_t>(result, entry.crc);
+    appendLE<uint32_t>(result, length32);         // compressed
+    appendLE<uint32_t>(result, length32);         // uncompressed
+    appendLE<uint16_t>(result, entry.name.size());
+    appendLE<uint16_t>(result, (zip64 ? 20 : 0) + padding);
+    result += entry.name;
+    if (zip64) {
+        appendLE<uint16_t>(result, 0x0001);
+        appendLE<uint16_t>(result, 16);
+        appendLE<uint64_t>(result, entry.length);
+        appendLE<uint64_t>(result, entry.length);
+    }
+    if (padding > 0) {
+        appendLE<uint16_t>(result, ZIP_PADDING_EXTRA_ID);
+        appendLE<uint16_t>(result, padding - 4);
+        result.append(padding - 4, '\0');
+    }
+    return result;
+}
+
+void appendZipCentralHeader(std::string & out, const ZipEntryInfo & entry,
+                            uint16_t dosTime, uint16_t dosDate)
+{
+    bool bigLength = entry.length >= ZIP64_LIMIT;
+    bool bigOffset = entry.headerOffset >= ZIP64_LIMIT;
+    uint32_t length32 = bigLength ? ZIP64_LIMIT : entry.length;
+    size_t extraLength = 0;
+    if (bigLength || bigOffset)
+        extraLength = 4 + 16 * bigLength + 8 * bigOffset;
+
+    appendLE<uint32_t>(out, 0x02014b50);
+    appendLE<uint16_t>(out, (3 << 8) | 45);       // made by unix, zip 4.5
+    appendLE<uint16_t>(out, extraLength ? 45 : 20);
+    appendLE<uint16_t>(out, 0x0800);
+    appendLE<uint16_t>(out, 0);
+    appendLE<uint16_t>(out, dosTime);
+    appendLE<uint16_t>(out, dosDate);
+    appendLE<uint32_t>(out, entry.crc);
+    appendLE<uint32_t>(out, length32);
+    appendLE<uint32_t>(out, length32);
+    appendLE<uint16_t>(out, entry.name.size());
+    appendLE<uint16_t>(out, extraLength);
+    appendLE<uint16_t>(out, 0);                   // comment length
+    appendLE<uint16_t>(out, 0);                   // disk number
+    appendLE<uint16_t>(out, 0);                   // internal attributes
+    appendLE<uint32_t>(out, 0100440u << 16);      // regular file, 0440
+    appendLE<uint32_t>(out, bigOffset ? ZIP64_LIMIT : entry.headerOffset);
+    out += entry.name;
+    if (extraLength) {
+        appendLE<uint16_t>(out, 0x0001);
+        appendLE<uint16_t>(out, extraLength - 4);
+        if (bigLength) {
+            appendLE<uint64_t>(out, entry.length);
+            appendLE<uint64_t>(out, entry.length);
+        }
+        if (bigOffset)
+            appendLE<uint64_t>(out, entry.headerOffset);
+    }
+}
+
+void appendZipEndOfDirectory(std::string & out, uint64_t numEntries,
+                             uint64_t directoryOffset,
+                             uint64_t directoryLength)
+{
+    if (numEntries >= 0xffff || directoryOffset >= ZIP64_LIMIT
+        || directoryLength >= ZIP64_LIMIT) {
+        uint64_t zip64EndOffset = directoryOffset + directoryLength;
+        appendLE<uint32_t>(out, 0x06064b50);
+        appendLE<uint64_t>(out, 44);              // size of the rest
+        appendLE<uint16_t>(out, (3 << 8) | 45);
+        appendLE<uint16_t>(out, 45);
+        appendLE<uint32_t>(out, 0);
+        appendLE<uint32_t>(out, 0);
+        appendLE<uint64_t>(out, numEntries);
+        appendLE<uint64_t>(out, numEntries);
+        appendLE<uint64_t>(out, directoryLength);
+        appendLE<uint64_t>(out, directoryOffset);
+
+        appendLE<uint32_t>(out, 0x07064b50);
+        appendLE<uint32_t>(out, 0);
+        appendLE<uint64_t>(out, zip64EndOffset);
+        appendLE<uint32_t>(out, 1);
+    }
+
+    appendLE<uint32_t>(out, 0x06054b50);
+    appendLE<uint16_t>(out, 0);
+    appendLE<uint16_t>(out, 0);
+    appendLE<uint16_t>(out, std::min<uint64_t>(numEntries, 0xffff));
+    appendLE<uint16_t>(out, std::min<uint64_t>(numEntries, 0xffff));
+    appendLE<uint32_t>(out, std::min<uint64_t>(directoryLength, ZIP64_LIMIT));
+    appendLE<uint32_t>(out, std::min<uint64_t>(directoryOffset, ZIP64_LIMIT));
+    appendLE<uint16_t>(out, 0);                   // comment length
+}
+
+} // file scope
+
 struct ZipStructuredSerializer::BaseItl: public Itl {
     BaseItl(Utf8String filename)
     {
-        stream.open(filename.rawString());
-        a.reset(archive_write_new(),
-                [] (struct archive * a) { archive_write_free(a); });
-        if (!a.get()) {
-            throw AnnotatedException
-                (500, "Couldn't create archive object");
+        time_t now = time(nullptr);
+        struct tm tm;
+        localtime_r(&now, &tm);
+        dosTime = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+        dosDate = ((std::max(tm.tm_year - 80, 0)) << 9) | ((tm.tm_mon + 1) << 5)
+            | tm.tm_mday;
+
+        // Local files are written with positional writes, so that entries
+        // can be written concurrently.  Anything else goes through a
+        // stream, one entry at a time.
+        std::string path = filename.rawString();
+        bool local = path.find("://") == std::string::npos;
+        if (path.compare(0, 7, "file://") == 0) {
+            path = path.substr(7);
+            local = true;
+        }
+
+        if (local) {
+            fd = ::open(path.c_str(),
+                        O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0666);
+            if (fd == -1) {
+                throw AnnotatedException
+                    (400, "Couldn't open zip file " + filename + ": "
+                     + strerror(errno));
+            }
+
+            // Not all filesystems support direct I/O; if not, large entries
+            // are written through the page cache like the rest
+            directFd = ::open(path.c_str(),
+                              O_WRONLY | O_DIRECT | O_CLOEXEC);
+        }
+        else {
+            stream.open(filename.rawString());
         }
-        archive_op(archive_write_set_format_zip);
-
-        // We compress each one individually using zstandard or not
-        // at all if we want to mmap.
-        archive_op(archive_write_zip_set_compression_store);
-        archive_op(archive_write_set_bytes_per_block, 65536);
-        archive_op(archive_write_open, this,
-                   &BaseItl::openCallback,
-                   &BaseItl::writeCallback,
-                   &BaseItl::closeCallback);
     }
 
     ~BaseItl()
     {
-        cerr << "closing archive file" << endl;
-        archive_op(archive_write_close);
+        finish();
     }
-    
-    // Perform a libarchive operation
-    template<typename Fn, typename... Args>
-    void archive_op(Fn&& op, Args&&... args)
+
+    /** Write the entry.  The space for it in the file is reserved under
+        the lock, after which the header and data are written without it,
+        so that concurrent callers write their entries in parallel.
+    */
+    void writeEntry(Path name, FrozenMemoryRegion region)
     {
-        int res = op(a.get(), std::forward<Args>(args)...);
-        if (res != ARCHIVE_OK) {
+        ZipEntryInfo entry;
+        entry.name = name.toUtf8String().rawString();
+        entry.length = region.length();
+        entry.crc = zipCrc32(region.data(), region.length());
+
+        if (entry.name.size() > 0xffff) {
             throw AnnotatedException
-                (500, string("Error writing zip file: ")
-                 + archive_error_string(a.get()));
+                (400, "Zip entry name is too long: " + name.toUtf8String());
         }
-    }
 
-    struct Entry {
-        Entry()
-        {
-            entry.reset(archive_entry_new(),
-                        [] (archive_entry * e) { archive_entry_free(e); });
-            if (!entry.get()) {
-                throw AnnotatedException
-                    (500, "Couldn't create archive entry");
-            }
+        std::unique_lock<std::mutex> guard(mutex);
+        if (finished) {
+            throw AnnotatedException
+                (500, "Zip entry " + name.toUtf8String()
+                 + " written after the file was finished");
         }
 
-        template<typename Fn, typename... Args>
-        void op(Fn&& op, Args&&... args)
-        {
-            /*int res =*/ op(entry.get(), std::forward<Args>(args)...);
-            /*
-            if (res != ARCHIVE_OK) {
-                throw AnnotatedException
-                    (500, string("Error writing zip file: ")
-                     + archive_error_string(entry.get()));
+        entry.headerOffset = currentOffset;
+        size_t padding
+            = entry.length >= DIRECT_IO_THRESHOLD
+            ? zipPadding(entry, DIRECT_IO_ALIGNMENT) : 0;
+        std::string header
+            = zipLocalHeader(entry, padding, dosTime, dosDate);
+        uint64_t dataOffset = entry.headerOffset + header.size();
+        currentOffset = dataOffset + entry.length;
+        entries.emplace_back(std::move(entry));
+
+        if (fd == -1) {
+            stream.write(header.data(), header.size());
+            stream.write(region.data(), region.length());
+            if (!stream) {
+                throw AnnotatedException(500, "Error writing zip file");
             }
-            */
+            return;
         }
-        
-        std::shared_ptr<struct archive_entry> entry;
-    };
 
-    void writeEntry(Path name, FrozenMemoryRegion region)
-    {
-        Entry entry;
-        entry.op(archive_entry_set_pathname, name.toUtf8String().rawData());
-        entry.op(archive_entry_set_size, region.length());
-        entry.op(archive_entry_set_filetype, AE_IFREG);
-        entry.op(archive_entry_set_perm, 0440);
-#if 0
-        for (auto & a: attrs) {
-            entry.op(archive_entry_xattr_add_entry, a.first.c_str(),
-                     a.second.data(), a.second.length());
-        }
-#endif
-        archive_op(archive_write_header, entry.entry.get());
-        auto written = archive_write_data(a.get(), region.data(), region.length());
-        if (written != region.length()) {
-            throw AnnotatedException(500, "Not all data written");
+        ++pendingWrites;
+        guard.unlock();
+
+        auto onDone = [&] ()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (--pendingWrites == 0)
+                    writesDone.notify_all();
+            };
+
+        try {
+            writeAll(fd, header.data(), header.size(), dataOffset - header.size());
+            writeData(region.data(), region.length(), dataOffset);
+        } catch (...) {
+            onDone();
+            throw;
         }
+        onDone();
     }
 
-    virtual void commit()
+    /** Write data at the given offset.  Large aligned writes go around the
+        page cache if possible; otherwise writeback is started immediately,
+        so that it's already under way when the file is closed.
+    */
+    void writeData(const char * data, size_t length, uint64_t offset)
     {
-    }
+        if (length < DIRECT_IO_THRESHOLD) {
+            writeAll(fd, data, length, offset);
+            return;
+        }
 
-    virtual Path path() const
-    {
-        return Path();
+        size_t done = 0;
+        if (offset % DIRECT_IO_ALIGNMENT == 0)
+            done = writeDirect(data, length & ~(DIRECT_IO_ALIGNMENT - 1), offset);
+
+        writeAll(fd, data + done, length - done, offset + done);
+        if (done == 0)
+            ::sync_file_range(fd, offset, length, SYNC_FILE_RANGE_WRITE);
     }
 
-    virtual BaseItl * base() const
+    /** Write with direct I/O.  Memory that isn't aligned is copied through
+        an aligned buffer.  Returns the number of bytes written, which is
+        zero if the filesystem doesn't support direct I/O.
+    */
+    size_t writeDirect(const char * data, size_t length, uint64_t offset)
     {
-        return const_cast<BaseItl *>(this);
+        if (directFd == -1 || !directIo)
+            return 0;
+
+        std::shared_ptr<char> buffer;
+        size_t done = 0;
+        while (done < length) {
+            const char * toWrite = data + done;
+            size_t n = length - done;
+            if ((size_t)toWrite % DIRECT_IO_ALIGNMENT != 0) {
+                if (!buffer) {
+                    void * mem = nullptr;
+                    if (posix_memalign(&mem, DIRECT_IO_ALIGNMENT,
+                                       DIRECT_IO_BUFFER) != 0)
+                        return done;
+                    buffer.reset((char *)mem, [] (char * p) { free(p); });
+                }
+                n = std::min(n, DIRECT_IO_BUFFER);
+                std::memcpy(buffer.get(), toWrite, n);
+                toWrite = buffer.get();
+            }
+
+            ssize_t res = ::pwrite(directFd, toWrite, n, offset + done);
+            if (res == -1 && errno == EINTR)
+                continue;
+            if (res == -1 && errno == EINVAL && done == 0) {
+                directIo = false;
+                return 0;
+            }
+            if (res == -1) {
+                throw AnnotatedException
+                    (500, "Error writing zip file: "
+                     + string(strerror(errno)));
+            }
+            done += res;
+
+            // A short write leaves us unaligned; do the rest normally
+            if (res % DIRECT_IO_ALIGNMENT != 0)
+                break;
+        }
+
+        return done;
     }
-    
-    static int openCallback(struct archive * a, void * voidThis)
 
+    static void writeAll(int fd, const char * data, size_t length,
+                         uint64_t offset)
     {
-        // Nothing to do here
-        return ARCHIVE_OK;
+        while (length > 0) {
+            ssize_t res = ::pwrite(fd, data, length, offset);
+            if (res == -1 && errno == EINTR)
+                continue;
+            if (res == -1) {
+                throw AnnotatedException
+                    (500, "Error writing zip file: "
+                     + string(strerror(errno)));
+            }
+            data += res;
+            length -= res;
+            offset += res;
+        }
     }
 
-    static int closeCallback(struct archive * a, void * voidThis)
+    /** Start writeback of everything written so far, without waiting for
+        it to finish.
+    */
+    virtual void commit()
     {
-        // Nothing to do here
-        cerr << "close callback" << endl;
-        return ARCHIVE_OK;
+        if (fd != -1)
+            ::sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
     }
 
-    /** Callback from libarchive when it needs to write some data to the
-        output file.  This simply hooks it into the filter ostream.
+    /** Wait for the entries being written, then write the central
+        directory.  The file is synced to disk in the background, so the
+        caller doesn't wait for the disk; the data is readable from the
+        page cache in the meantime.
     */
-    static __LA_SSIZE_T	writeCallback(struct archive * a,
-                                      void * voidThis,
-                                      const void * buffer,
-                                      size_t length)
+    void finish()
     {
-        BaseItl * that = reinterpret_cast<BaseItl *>(voidThis);
+        std::unique_lock<std::mutex> guard(mutex);
+        writesDone.wait(guard, [&] () { return pendingWrites == 0; });
+        if (finished)
+            return;
+        finished = true;
+
+        std::string directory;
+        for (auto & entry: entries)
+            appendZipCentralHeader(directory, entry, dosTime, dosDate);
+        uint64_t directoryLength = directory.size();
+        appendZipEndOfDirectory(directory, entries.size(), currentOffset,
+                                directoryLength);
+
+        if (fd == -1) {
+            stream.write(directory.data(), directory.size());
+            stream.close();
+            return;
+        }
 
-        //cerr << "need to write " << archive_write_get_bytes_in_last_block(that->a.get()) << endl;
+        if (directFd != -1)
+            ::close(directFd);
+        writeAll(fd, directory.data(), directory.size(), currentOffset);
+
+        int toSync = fd;
+        fd = -1;
+        std::thread([toSync] ()
+                    {
+                        ::fdatasync(toSync);
+                        ::close(toSync);
+                    }).detach();
+    }
 
-        that->stream.write((const char *)buffer, length);
-        if (!that->stream)
-            return -1;
-        //cerr << "wrote " << length << " characters" << endl;
-        return length;
+    virtual Path path() const
+    {
+        return Path();
     }
 
-    filter_ostream stream;
-    std::shared_ptr<struct archive> a;
+    virtual BaseItl * base() const
+    {
+        return const_cast<BaseItl *>(this);
+    }
+
+    std::mutex mutex;
+    std::condition_variable writesDone;
+    int pendingWrites = 0;
+    bool finished = false;
+    uint64_t currentOffset = 0;
+    std::vector<ZipEntryInfo> entries;
+    uint16_t dosTime = 0;
+    uint16_t dosDate = 0;
+
+    int fd = -1;                       ///< Local file, or -1 for a stream
+    int directFd = -1;                 ///< Same file opened for direct I/O
+    std::atomic<bool> directIo{true};  ///< Filesystem accepts direct I/O
+    filter_ostream stream;             ///< Non-local file
 };
 
 struct ZipStructuredSerializer::RelativeItl: public Itl {
@@ -227,6 +535,14 @@ struct ZipStructuredSerializer::EntrySerializer: public MemorySerializer {
         return frozen = MemorySerializer::freeze(region);
     }
 
+    /** The region is already frozen, so it's written straight from where
+        it is rather than being copied into memory of our own first.
+    */
+    virtual FrozenMemoryRegion copy(const FrozenMemoryRegion & region) override
+    {
+        return frozen = region;
+    }
+
     Itl * itl;
     PathElement entryName;
     FrozenMemoryRegion frozen;
@@ -8,6 +8,8 @@ LIBMLDB_BUILTIN_BASE_SOURCES:= \
 	filtered_dataset.cc \
 	sampled_dataset.cc \
 	union_dataset.cc \
+	distributed_dataset.cc \
+	replica_dataset.cc \
 	\
 	basic_procedures.cc \
 	sql_functions.cc \
@@ -20,6 +22,7 @@ LIBMLDB_BUILTIN_BASE_SOURCES:= \
 	docker_plugin.cc \
 	external_python_procedure.cc \
 	script_function.cc \
+	script_worker_pool.cc \
 	\
 	mock_procedure.cc \
 	\
@@ -39,6 +42,7 @@ LIBMLDB_BUILTIN_BASE_SOURCES:= \
 LIBMLDB_BUILTIN_BASE_LINK:= \
 	mldb_core \
 	mldb_engine \
+	http \
 	runner \
 	git2 \
 	ssh2 \
@@ -23,6 +23,9 @@
 #include "mldb/builtin/merged_dataset.h"
 #include "mldb/utils/log.h"
 #include "mldb/types/structure_description.h"
+#include <condition_variable>
+#include <deque>
+#include <thread>
 
 
 using namespace std;
@@ -36,6 +39,12 @@ namespace MLDB {
 /* CONTINUOUS DATASET CONFIG                                                 */
 /*****************************************************************************/
 
+ContinuousDatasetConfig::
+ContinuousDatasetConfig()
+    : maxPendingSaves(2)
+{
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(ContinuousDatasetConfig);
 
 ContinuousDatasetConfigDescription::
@@ -49,6 +58,13 @@ ContinuousDatasetConfigDescription()
              "Procedure that will save a storage dataset returning metadata");
     addField("commitInterval", &ContinuousDatasetConfig::commitInterval,
              "Interval between auto-commit operations");
+    addField("maxPendingSaves", &ContinuousDatasetConfig::maxPendingSaves,
+             "Maximum number of rotated datasets that can be waiting to be "
+             "saved (including the one being saved).  Datasets are saved "
+             "in the background; once this many are waiting, a rotation "
+             "waits for the oldest save to finish before it swaps in a new "
+             "dataset.  Recording is never blocked.",
+             2);
 }
 
 
@@ -60,9 +76,16 @@ struct ContinuousDataset::Itl final {
     Itl(MldbEngine * engine, const ContinuousDatasetConfig & config)
         : engine(engine),
           current(gcLock),
+          maxPendingSaves(config.maxPendingSaves),
+          lastRotate(Date::now().secondsSinceEpoch()),
           lastCommit(Date::now().secondsSinceEpoch()),
           logger(MLDB::getMldbLog<ContinuousWindowDataset>())
     {
+        if (maxPendingSaves < 1)
+            throw AnnotatedException(400, "Continuous dataset maxPendingSaves "
+                                     "must be at least 1",
+                                     "continuousDatasetConfig", config);
+
         initRoutes();
 
         try {
@@ -95,23 +118,38 @@ struct ContinuousDataset::Itl final {
         
         // Perform a first rotation, so that everything is properly set
         // up for the rotation.
-        rotate(Date::positiveInfinity());
+        rotate(Date::positiveInfinity(), false /* waitForSave */);
 
         ExcAssert(current.val);
 
+        // Start saving in the background.  The first thing it will do is
+        // to create the spare dataset for the next rotation.
+        saveThread = std::thread([this] () { runSaves(); });
+
         // Set up an interval for the commit operation
         if (config.commitInterval.number > 0) {
             timer = engine->getTimer(Date::now().plusSeconds(config.commitInterval.number),
                                      config.commitInterval.number,
                                      [=] (Date date)
                                      {
-                                         rotate(date);
+                                         rotate(date, false /* waitForSave */);
                                      });
         }
     }
 
     ~Itl()
     {
+        // No more rotations from the timer...
+        timer = WatchT<Date>();
+
+        // ... and finish the saves that are already queued before we go
+        {
+            std::unique_lock<std::mutex> guard(saveMutex);
+            shutdown = true;
+            saveCond.notify_all();
+        }
+        if (saveThread.joinable())
+            saveThread.join();
     }
 
     MldbEngine * engine;
@@ -136,6 +174,12 @@ struct ContinuousDataset::Itl final {
                                JsonParam<Utf8String>("where", "Filter to choose which metadata databases to load"),
                                JsonParamDefault<bool>("live", "If true, the returned dataset is live and will be updated in real-time as events are recorded", false));
 #endif
+        addRouteSyncJsonReturn(router, "/saveStats", {"GET"},
+                               "Return statistics about the background saving "
+                               "of rotated datasets",
+                               "Save queue length, lag and durations",
+                               &Itl::getSaveStats,
+                               this);
     }
 
     Any
@@ -166,41 +210,76 @@ struct ContinuousDataset::Itl final {
         std::atomic<bool> hasData;         ///< Is there any data in it?
     };
 
+    /// A dataset that was rotated out and is waiting to be saved
+    struct PendingSave {
+        std::unique_ptr<Current> old;      ///< What was swapped out
+        Date commitStarted;                ///< When the rotate was asked for
+        Date rotated;                      ///< When it was swapped out
+        uint64_t sequence;                 ///< Number of the rotation
+    };
+
     GcLock gcLock;
     RcuProtected<Current> current;
 
-    /// Mutex for phase 1 of the rotate, which is to swap out the datasets.
+    /// Mutex to serialize rotations, which swap out the datasets.
     std::mutex rotateMutex;
 
-    /// Mutex for phase 2 of the rotate, which is to save the dataset.  The
-    /// mutex for phase 1 is released once this mutex is acquired.
-    std::mutex saveMutex;
+    /// Mutex protecting the spare dataset, the queue of saves and the
+    /// save statistics below.  It's never held while a procedure runs.
+    mutable std::mutex saveMutex;
+
+    /// Signalled whenever anything protected by saveMutex changes
+    std::condition_variable saveCond;
+
+    /// Thread that saves rotated datasets and creates the spares
+    std::thread saveThread;
+
+    /// Dataset created ahead of time to be swapped in on the next rotation,
+    /// so that the rotation itself doesn't need to wait for
+    /// createStorageDataset to run.
+    std::shared_ptr<Dataset> spare;
+
+    /// Set when the spare was used and another one needs to be created
+    bool needSpare = false;
+
+    /// Set when we're being destroyed
+    bool shutdown = false;
+
+    /// Datasets waiting to be saved, oldest first.  The one being saved
+    /// stays at the front until it's done, so the size of this is the
+    /// number of saves in flight.
+    std::deque<PendingSave> pendingSaves;
+
+    /// Bound on the size of pendingSaves
+    int maxPendingSaves;
+
+    uint64_t rotations = 0;            ///< Number of rotations done
+    uint64_t savedThrough = 0;         ///< Rotations up to here are saved
+    uint64_t lastFailed = 0;           ///< Last rotation whose save failed
+    std::string lastError;             ///< Error from that save
+    uint64_t savesCompleted = 0;       ///< Saves that succeeded
+    uint64_t savesFailed = 0;          ///< Saves that threw
+    double lastSaveSeconds = 0;        ///< Time to run the last save
+    double lastSaveLagSeconds = 0;     ///< Rotation to end of last save
+    double maxSaveLagSeconds = 0;      ///< Maximum of the above
 
     /// Used live datasets to know about datasets that are created and
     /// rotated.
     WatchesT<std::shared_ptr<Dataset> > datasetWatches;
 
+    /// Date of the last rotation
+    std::atomic<double> lastRotate;
+
     /// Date of the last commit
     std::atomic<double> lastCommit;
 
     shared_ptr<spdlog::logger> logger;
 
-    /** Rotate the dataset, atomically, and add it to the metadata store. */
-    void rotate(Date commitStarted)
+    /** Run the createStorageDataset procedure to create a dataset to
+        record into.
+    */
+    std::shared_ptr<Dataset> createStorage()
     {
-        if (lastCommit.load() > commitStarted.secondsSinceEpoch())
-            return;
-
-        std::unique_lock<std::mutex> rotateGuard(rotateMutex);
-
-        // If we already commited after the time rotate() was called, then
-        // nothing to do.
-        if (lastCommit.load() > commitStarted.secondsSinceEpoch())
-            return;
-
-        // First, create a new storage dataset to hold anything that comes
-        // along while we're rotating the old
-
         ProcedureRunConfig runConfig;
 
         auto storageOutput
@@ -208,31 +287,170 @@ struct ContinuousDataset::Itl final {
 
         INFO_MSG(logger) << "output of storage is " << jsonEncode(storageOutput);
 
-        std::unique_ptr<Current> newCurrent(new Current());
-        newCurrent->dataset
-            = obtainDataset(engine,
-                            storageOutput.results.getField("config")
-                            .convert<PolyConfig>(), nullptr);
-        
-        // Now, swap it in...
-        auto old = current.replaceCustomCleanup(newCurrent.release());
+        return obtainDataset(engine,
+                             storageOutput.results.getField("config")
+                             .convert<PolyConfig>(), nullptr);
+    }
 
-        // In initialization, we don't have an old dataset so we get out
-        // here.
-        if (!old || !old->dataset)
+    /** Rotate the dataset, atomically, and queue the old one to be saved
+        and added to the metadata store.  Recording continues throughout,
+        as the rotation is only a pointer swap with the spare dataset.  If
+        waitForSave is true, then this only returns once the old dataset
+        (and any rotated before it) have been saved.
+    */
+    void rotate(Date commitStarted, bool waitForSave)
+    {
+        if (!waitForSave
+            && lastRotate.load() > commitStarted.secondsSinceEpoch())
             return;
 
-        std::unique_lock<std::mutex> saveGuard(saveMutex);
+        std::unique_lock<std::mutex> rotateGuard(rotateMutex);
+        std::unique_lock<std::mutex> guard(saveMutex);
+
+        uint64_t sequence;
+
+        // If we already rotated after the time rotate() was called, then
+        // nothing to do but wait for that rotation to be saved.
+        if (lastRotate.load() > commitStarted.secondsSinceEpoch()) {
+            sequence = rotations;
+        }
+        else {
+            // Don't let unsaved datasets pile up.  We wait here rather than
+            // after the swap so that recording continues into the current
+            // dataset in the meantime.
+            saveCond.wait(guard, [&] ()
+                          {
+                              return pendingSaves.size() < (size_t)maxPendingSaves;
+                          });
+
+            // Normally, the spare is ready.  If it isn't (we're
+            // initializing, or rotations are coming faster than
+            // createStorageDataset can keep up) we create one here.
+            std::shared_ptr<Dataset> dataset = std::move(spare);
+            spare.reset();
+            if (!dataset) {
+                guard.unlock();
+                dataset = createStorage();
+                guard.lock();
+            }
+
+            std::unique_ptr<Current> newCurrent(new Current());
+            newCurrent->dataset = std::move(dataset);
+            newCurrent->hasData = false;
+
+            // Now, swap it in...
+            auto old = current.replaceCustomCleanup(newCurrent.release());
+
+            needSpare = true;
+            saveCond.notify_all();
+
+            // In initialization, we don't have an old dataset so we get out
+            // here.
+            if (!old || !old->dataset)
+                return;
+
+            sequence = ++rotations;
+            lastRotate = commitStarted.secondsSinceEpoch();
+
+            pendingSaves.push_back({ std::move(old), commitStarted,
+                                     Date::now(), sequence });
+        }
 
-        // If we already commited after the time rotate() was called, then
-        // nothing to do.
-        if (lastCommit.load() > commitStarted.secondsSinceEpoch())
-            return;
-        
-        // Release the rotate mutex
         rotateGuard.unlock();
-        
-        std::shared_ptr<Dataset> savedDataset = old->dataset;
+
+        if (!waitForSave)
+            return;
+
+        saveCond.wait(guard, [&] () { return savedThrough >= sequence; });
+
+        if (lastFailed == sequence) {
+            throw AnnotatedException(500, "Error saving continuous dataset: "
+                                     + lastError);
+        }
+    }
+
+    /** Background thread that keeps a spare dataset ready and saves rotated
+        datasets in the order they were rotated.  On shutdown it finishes
+        the saves that are queued before exiting.
+    */
+    void runSaves()
+    {
+        std::unique_lock<std::mutex> guard(saveMutex);
+
+        for (;;) {
+            saveCond.wait(guard, [&] ()
+                          {
+                              return shutdown || needSpare
+                                  || !pendingSaves.empty();
+                          });
+
+            if (needSpare && !shutdown) {
+                needSpare = false;
+                guard.unlock();
+
+                std::shared_ptr<Dataset> dataset;
+                try {
+                    dataset = createStorage();
+                } MLDB_CATCH_ALL {
+                    // The next rotation will try again in the foreground
+                    ERROR_MSG(logger) << "error creating spare storage "
+                                      << "dataset: " << getExceptionString();
+                }
+
+                guard.lock();
+                if (!spare)
+                    spare = std::move(dataset);
+                continue;
+            }
+
+            if (pendingSaves.empty()) {
+                if (shutdown)
+                    return;
+                continue;
+            }
+
+            // References to deque elements survive push_back, so this
+            // stays valid while rotate() adds more behind it.
+            PendingSave & save = pendingSaves.front();
+            guard.unlock();
+
+            Date started = Date::now();
+            std::string error;
+            try {
+                saveDataset(*save.old, save.commitStarted);
+            } MLDB_CATCH_ALL {
+                error = getExceptionString();
+                ERROR_MSG(logger) << "error saving continuous dataset: "
+                                  << error;
+            }
+            Date finished = Date::now();
+
+            guard.lock();
+
+            if (error.empty()) {
+                ++savesCompleted;
+            }
+            else {
+                ++savesFailed;
+                lastFailed = save.sequence;
+                lastError = error;
+            }
+            lastSaveSeconds = finished.secondsSince(started);
+            lastSaveLagSeconds = finished.secondsSince(save.rotated);
+            maxSaveLagSeconds = std::max(maxSaveLagSeconds, lastSaveLagSeconds);
+            savedThrough = save.sequence;
+
+            pendingSaves.pop_front();
+            saveCond.notify_all();
+        }
+    }
+
+    /** Save a dataset that was rotated out, and add it to the metadata
+        store.
+    */
+    void saveDataset(Current & old, Date commitStarted)
+    {
+        std::shared_ptr<Dataset> savedDataset = old.dataset;
 
         // ... and wait for all users to stop using it.  Once we're past this
         // line, there is no possibility that old will be modified by
@@ -242,7 +460,7 @@ struct ContinuousDataset::Itl final {
         gcLock.visibleBarrier();
 
         // If there is no data in the dataset, then don't save anything
-        if (!old->hasData) {
+        if (!old.hasData) {
             lastCommit = commitStarted.secondsSinceEpoch();
             return;
         }
@@ -291,7 +509,31 @@ struct ContinuousDataset::Itl final {
         // Force a write-out of the dataset.  We only exit once it's
         // done.  This allows a call to commit() to be used to guarantee
         // that what was written up to now is actually in the database.
-        rotate(Date::now());
+        rotate(Date::now(), true /* waitForSave */);
+    }
+
+    Json::Value getSaveStats() const
+    {
+        std::unique_lock<std::mutex> guard(saveMutex);
+
+        Json::Value result;
+        result["pendingSaves"] = (Json::UInt)pendingSaves.size();
+        result["maxPendingSaves"] = maxPendingSaves;
+        result["rotations"] = (Json::UInt)rotations;
+        result["savesCompleted"] = (Json::UInt)savesCompleted;
+        result["savesFailed"] = (Json::UInt)savesFailed;
+        if (savesFailed)
+            result["lastError"] = lastError;
+        result["lastSaveSeconds"] = lastSaveSeconds;
+        result["lastSaveLagSeconds"] = lastSaveLagSeconds;
+        result["maxSaveLagSeconds"] = maxSaveLagSeconds;
+        // How long the oldest unsaved data has been waiting
+        result["currentSaveLagSeconds"]
+            = pendingSaves.empty()
+            ? 0.0 : Date::now().secondsSince(pendingSaves.front().rotated);
+        result["lastCommit"]
+            = Date::fromSecondsSinceEpoch(lastCommit.load()).printIso8601();
+        return result;
     }
 
     virtual RestRequestMatchResult
@@ -385,7 +627,8 @@ void
 ContinuousDataset::
 commit()
 {
-    return itl->commit();
+    itl->commit();
+    dataChanged();
 }
     
 std::pair<Date, Date>
@@ -447,7 +690,8 @@ regContinuous(builtinPackage(),
 
 ContinuousWindowDatasetConfig::
 ContinuousWindowDatasetConfig()
-    : datasetFilter(SqlExpression::parse("true"))
+    : datasetFilter(SqlExpression::parse("true")),
+      partialAggregates(false)
 {
 }
 
@@ -466,6 +710,13 @@ ContinuousWindowDatasetConfigDescription()
     addField("datasetFilter", &ContinuousWindowDatasetConfig::datasetFilter,
              "Filter to apply to dataset metadata when choosing datasets",
              SqlExpression::parse("true"));
+    addField("partialAggregates",
+             &ContinuousWindowDatasetConfig::partialAggregates,
+             "Keep the partial aggregates of GROUP BY queries for each "
+             "dataset in the window, so that repeating a query only "
+             "aggregates the datasets that changed.  This is only correct "
+             "if no row name is in more than one of the datasets.",
+             false);
 }
 
 
@@ -566,9 +817,16 @@ ContinuousWindowDataset(MldbEngine * owner,
     }
 
     try {
-        // Obtain the merged dataset, recursively
-        std::shared_ptr<Dataset> underlying
-            = obtainDataset(engine, toLoadConfig);
+        // Obtain the merged dataset, recursively.  For partial
+        // aggregates, we keep hold of each of the datasets it merges.
+        std::shared_ptr<Dataset> underlying;
+        if (config.partialAggregates) {
+            auto params = toLoadConfig.params.convert<MergedDatasetConfig>();
+            for (auto & c: params.datasets)
+                partitions.emplace_back(obtainDataset(engine, c));
+            underlying = std::make_shared<MergedDataset>(engine, partitions);
+        }
+        else underlying = obtainDataset(engine, toLoadConfig);
         setUnderlying(underlying);
     } MLDB_CATCH_ALL {
         rethrowException(-1, "Error initializing continuous window dataset in "
@@ -577,6 +835,34 @@ ContinuousWindowDataset(MldbEngine * owner,
     }
 }
 
+std::vector<std::shared_ptr<Dataset> >
+ContinuousWindowDataset::
+getAggregationPartitions() const
+{
+    return partitions;
+}
+
+std::vector<MatrixNamedRow>
+ContinuousWindowDataset::
+queryStructured(const SelectExpression & select,
+                const WhenExpression & when,
+                const SqlExpression & where,
+                const OrderByExpression & orderBy,
+                const TupleExpression & groupBy,
+                const std::shared_ptr<SqlExpression> having,
+                const std::shared_ptr<SqlExpression> rowName,
+                ssize_t offset,
+                ssize_t limit,
+                Utf8String alias) const
+{
+    if (partitions.empty())
+        return ForwardedDataset::queryStructured(select, when, where, orderBy,
+                                                 groupBy, having, rowName,
+                                                 offset, limit, alias);
+    return Dataset::queryStructured(select, when, where, orderBy, groupBy,
+                                    having, rowName, offset, limit, alias);
+}
+
 static RegisterDatasetType<ContinuousWindowDataset,
                            ContinuousWindowDatasetConfig>
 regContinuousWindow(builtinPackage(),
@@ -26,10 +26,13 @@ namespace MLDB {
 /*****************************************************************************/
 
 struct ContinuousDatasetConfig {
+    ContinuousDatasetConfig();
+
     PolyConfigT<Dataset> metadataDataset;          ///< Dataset for metadata storage
     PolyConfigT<Procedure> createStorageDataset;   ///< Create a storage dataset
     PolyConfigT<Procedure> saveStorageDataset;     ///< Save a storage dataset
     TimePeriod commitInterval;                     ///< Frequency for auto-commit
+    int maxPendingSaves;                           ///< Bound on queued saves
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ContinuousDatasetConfig);
@@ -91,6 +94,7 @@ struct ContinuousWindowDatasetConfig {
     Date from;                         ///< Earliest data point to use
     Date to;                           ///< Latest data point to use
     std::shared_ptr<SqlExpression> datasetFilter;  ///< Filter for datasets
+    bool partialAggregates;            ///< Aggregate each dataset separately
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ContinuousWindowDatasetConfig);
@@ -111,6 +115,26 @@ struct ContinuousWindowDataset: public ForwardedDataset {
     /// Dataset in which our metadata lives
     std::shared_ptr<Dataset> metadataDataset;
 
+    /// Datasets that were merged, if partialAggregates was set
+    std::vector<std::shared_ptr<Dataset> > partitions;
+
+    virtual std::vector<std::shared_ptr<Dataset> >
+    getAggregationPartitions() const;
+
+    /// With partial aggregates, queries need to run over this dataset
+    /// rather than being forwarded to the merged dataset
+    virtual std::vector<MatrixNamedRow>
+    queryStructured(const SelectExpression & select,
+                    const WhenExpression & when,
+                    const SqlExpression & where,
+                    const OrderByExpression & orderBy,
+                    const TupleExpression & groupBy,
+                    const std::shared_ptr<SqlExpression> having,
+                    const std::shared_ptr<SqlExpression> rowName,
+                    ssize_t offset,
+                    ssize_t limit,
+                    Utf8String alias = "") const;
+
     PolyConfigT<const Dataset>
     getDatasetConfig(std::shared_ptr<SqlExpression> datasetFilter,
                      Date earliest,
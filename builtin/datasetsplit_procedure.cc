@@ -17,6 +17,7 @@
 #include "mldb/builtin/sql_config_validator.h"
 #include "mldb/builtin/sql_expression_extractors.h"
 #include "mldb/engine/bound_queries.h"
+#include "mldb/base/parallel.h"
 #include <random>
 
 using namespace std;
@@ -144,19 +145,31 @@ run(const ProcedureRunConfig & run,
 
     auto boundDataset = runProcConf.labels.stm->from->bind(context, convertProgressToJson);
 
-    std::vector<RowPath> rowPaths;
+    /// A row to split, with the columns of its labels
+    struct RowLabels {
+        RowPath rowPath;
+        std::vector<PathElement> labels;
+    };
+
+    std::vector<RowLabels> rows;
 
     //Get all the row names selected by the specified FROM/WHERE
-    //in a deterministic order
+    //in a deterministic order, along with their labels.  Only the
+    //labels are read here; the rows themselves are read when they are
+    //written out.
      auto processor = [&] (NamedRowValue & row_,
                            const std::vector<ExpressionValue> & extraVals)
         {
-            rowPaths.push_back(std::move(row_.rowName));
+            RowLabels row;
+            row.rowPath = std::move(row_.rowName);
+            row.labels.reserve(row_.columns.size());
+            for (auto & c: row_.columns)
+                row.labels.emplace_back(std::move(std::get<0>(c)));
+            rows.emplace_back(std::move(row));
             return true;            
         };
-    SelectExpression select("1");
     std::vector<std::shared_ptr<SqlExpression> > extra;
-    BoundSelectQuery(select,
+    BoundSelectQuery(runProcConf.labels.stm->select,
                      *boundDataset.dataset,
                      boundDataset.asName, runProcConf.labels.stm->when,
                      *runProcConf.labels.stm->where,
@@ -172,27 +185,22 @@ run(const ProcedureRunConfig & run,
         rng.seed(runProcConf.randomSeed);
 
     if (!runProcConf.reproducible) {
-        std::shuffle(rowPaths.begin(), rowPaths.end(), rng);
+        std::shuffle(rows.begin(), rows.end(), rng);
     }
     else {
         // reproducible (basic) shuffle algorithm
-        reproducible_shuffle(rowPaths.begin(), rowPaths.end(), rng);
+        reproducible_shuffle(rows.begin(), rows.end(), rng);
     }
 
     size_t numFolds = runProcConf.splits.size();
     std::vector<size_t> distributions(numFolds); //Rows per Fold
     std::map<PathElement, std::vector<size_t>> sums; //distribution per label
+    std::vector<int> rowFolds(rows.size());
 
-    SqlExpressionDatasetScope datasetScope(boundDataset.dataset, boundDataset.asName);
-    BoundSqlExpression boundSelect = runProcConf.labels.stm->select.bind(datasetScope);
-
-    //Distribute the rows using a greedy approach.
-    ExpressionValue storage;
+    //Distribute the rows using a greedy approach.  This only looks at
+    //the labels, so it's cheap even though it's sequential.
     size_t numRowsAdded = 0;
-    for (const auto& rowPath : rowPaths) {
-        MatrixNamedRow row = boundDataset.dataset->getMatrixView()->getRow(rowPath);
-        auto rowScope = datasetScope.getRowScope(row);
-        auto rowValue = boundSelect(rowScope, storage, GET_ALL);
+    for (size_t r = 0;  r < rows.size();  ++r) {
         size_t bestFold = 0;
         float diff = 0.f;
         bool unknown = false;
@@ -209,8 +217,7 @@ run(const ProcedureRunConfig & run,
         }
 
         //check the best fold according to label distribution
-        auto onColumn = [&] (const PathElement & columnName,
-                             const ExpressionValue & val) {
+        auto onColumn = [&] (const PathElement & columnName) {
             auto it = sums.find(columnName);
             if (it == sums.end()) {
                 //first time we see this label, put the row in fold 0
@@ -230,7 +237,7 @@ run(const ProcedureRunConfig & run,
                         //This fold does not have the label, give it
                         bestFold = i;
                         unknown = true;
-                        return true;
+                        return;
                     }
                     else {
                         labelSum += v;
@@ -259,29 +266,58 @@ run(const ProcedureRunConfig & run,
                     bestFold = worstFold;
                 }
             }
-
-            return true;
         };
         //find the best fold
-        rowValue.forEachColumn(onColumn);
+        for (const auto & label: rows[r].labels)
+            onColumn(label);
 
         //update distributions
-        auto updateDistribution = [&] (const PathElement & columnName,
-                             const ExpressionValue & val) {
-            auto it = sums.find(columnName);
+        for (const auto & label: rows[r].labels) {
+            auto it = sums.find(label);
             ExcAssert(it != sums.end());
             it->second[bestFold]++;
-            return true;
-        };
+        }
 
-        rowValue.forEachColumn(updateDistribution);
         distributions[bestFold]++;
-        datasets[bestFold]->recordRow(rowPath, row.columns);
+        rowFolds[r] = bestFold;
         numRowsAdded++;
     }
 
+    //Write the rows out.  Each block of rows is a chunk of each of the
+    //output datasets, so that they are read and written in parallel and
+    //still come out the same each time.
+    std::vector<Dataset::MultiChunkRecorder> recorders;
     for (auto& outputDataset : datasets)
-        outputDataset->commit();
+        recorders.emplace_back(outputDataset->getChunkRecorder());
+
+    auto matrix = boundDataset.dataset->getMatrixView();
+    static constexpr size_t ROWS_PER_CHUNK = 4096;
+    size_t numChunks = (rows.size() + ROWS_PER_CHUNK - 1) / ROWS_PER_CHUNK;
+
+    auto recordChunk = [&] (size_t chunk)
+        {
+            size_t begin = chunk * ROWS_PER_CHUNK;
+            size_t end = std::min(begin + ROWS_PER_CHUNK, rows.size());
+
+            std::vector<std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > >
+                foldRows(numFolds);
+            for (size_t r = begin;  r < end;  ++r) {
+                MatrixNamedRow row = matrix->getRow(rows[r].rowPath);
+                foldRows[rowFolds[r]].emplace_back(std::move(row.rowName),
+                                                   std::move(row.columns));
+            }
+
+            for (size_t f = 0;  f < numFolds;  ++f) {
+                auto chunkRecorder = recorders[f].newChunk(chunk);
+                chunkRecorder->recordRowsDestructive(std::move(foldRows[f]));
+                chunkRecorder->finishedChunk();
+            }
+        };
+
+    parallelMap(0, numChunks, recordChunk);
+
+    for (auto& recorder : recorders)
+        recorder.commit();
 
     Json::Value results;
     std::vector<Utf8String> incompleteLabels;
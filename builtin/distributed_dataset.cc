@@ -0,0 +1,647 @@
+/** distributed_dataset.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Dataset whose rows are partitioned over several MLDB instances.
+*/
+
+#include "distributed_dataset.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/builtin/sub_dataset.h"
+#include "mldb/engine/analytics.h"
+#include "mldb/engine/dataset_scope.h"
+#include "mldb/http/http_batch_fetch.h"
+#include "mldb/rest/rest_request_params.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/vector_description.h"
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* DISTRIBUTED DATASET CONFIG                                                */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(DistributedDatasetPartition);
+
+DistributedDatasetPartitionDescription::
+DistributedDatasetPartitionDescription()
+{
+    addField("uri", &DistributedDatasetPartition::uri,
+             "Base URI of the MLDB instance that holds the partition, for "
+             "example http://host:17782.  An empty URI means this instance.",
+             Utf8String());
+    addField("dataset", &DistributedDatasetPartition::dataset,
+             "Name of the dataset that holds the partition on that instance");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(DistributedDatasetConfig);
+
+DistributedDatasetConfigDescription::
+DistributedDatasetConfigDescription()
+{
+    nullAccepted = true;
+
+    addField("partitions", &DistributedDatasetConfig::partitions,
+             "Partitions of the dataset.  Each row should be in only one of "
+             "them.");
+    addField("maxRetries", &DistributedDatasetConfig::maxRetries,
+             "Number of times to retry a query on a remote partition after "
+             "a connection error or a temporary HTTP error",
+             0);
+}
+
+static RegisterDatasetType<DistributedDataset, DistributedDatasetConfig>
+regDistributed(builtinPackage(),
+               "distributed",
+               "Dataset partitioned over several MLDB instances",
+               "datasets/DistributedDataset.md.html");
+
+namespace {
+
+Utf8String quoteIdentifier(const Utf8String & name)
+{
+    Utf8String result = "\"";
+    for (auto c: name) {
+        if (c == '"')
+            result += "\"\"";
+        else result += c;
+    }
+    return result + "\"";
+}
+
+/// SQL text of an expression, to ship it to a partition
+const Utf8String & getSurface(const SqlExpression & expr)
+{
+    if (expr.surface.empty())
+        throw AnnotatedException(400, "Distributed datasets can only run "
+                                 "queries whose expressions were parsed "
+                                 "from SQL",
+                                 "expression", expr.print());
+    return expr.surface;
+}
+
+Utf8String join(const std::vector<Utf8String> & items)
+{
+    Utf8String result;
+    for (auto & i: items) {
+        if (!result.empty())
+            result += ", ";
+        result += i;
+    }
+    return result;
+}
+
+Utf8String indexedName(const char * prefix, size_t i)
+{
+    return prefix + Utf8String(to_string(i));
+}
+
+/** Replace the group keys and aggregators in the expression, which are
+    matched by their printed form, with the expressions that merge what
+    the partitions calculated for them.
+*/
+std::shared_ptr<SqlExpression>
+replaceForMerge(const std::shared_ptr<SqlExpression> & p,
+                const std::map<Utf8String, std::shared_ptr<SqlExpression> >
+                    & replacements)
+{
+    std::function<std::shared_ptr<SqlExpression> (std::shared_ptr<SqlExpression> a)>
+        doArg;
+
+    auto onChild = [&] (std::vector<std::shared_ptr<SqlExpression> > args)
+        {
+            for (auto & a: args) {
+                a = doArg(a);
+            }
+
+            return args;
+        };
+
+    doArg = [&] (std::shared_ptr<SqlExpression> a)
+        -> std::shared_ptr<SqlExpression>
+        {
+            auto it = replacements.find(a->print());
+            if (it != replacements.end())
+                return it->second;
+            return a->transform(onChild);
+        };
+
+    auto result = doArg(p);
+    result->surface = result->print();
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* DISTRIBUTED DATASET INTERNALS                                             */
+/*****************************************************************************/
+
+struct DistributedDataset::Itl {
+
+    Itl(MldbEngine * engine, DistributedDatasetConfig config)
+        : engine(engine), config(std::move(config))
+    {
+        if (this->config.partitions.empty())
+            throw AnnotatedException(400, "Distributed dataset needs at "
+                                     "least one partition");
+        for (auto & p: this->config.partitions) {
+            if (p.dataset.empty())
+                throw AnnotatedException(400, "Partition of distributed "
+                                         "dataset has no dataset name",
+                                         "uri", p.uri);
+        }
+    }
+
+    MldbEngine * engine;
+    DistributedDatasetConfig config;
+
+    mutable std::mutex copyMutex;
+    mutable std::shared_ptr<Dataset> copy;
+
+    /** Run a query on each of the partitions, all at once, and return
+        the rows that each one returned.  The query is made by makeQuery
+        from the quoted name of the partition's dataset.  Remote partitions
+        are sent the query with a GET of /v1/query; those on this instance
+        run it directly.
+    */
+    std::vector<std::vector<MatrixNamedRow> >
+    scatter(const std::function<Utf8String (const Utf8String &)> & makeQuery)
+        const
+    {
+        size_t n = config.partitions.size();
+        std::vector<std::vector<MatrixNamedRow> > results(n);
+        std::vector<Utf8String> queries(n);
+        std::vector<std::string> urls;
+        std::vector<size_t> urlPartitions;
+
+        for (size_t i = 0;  i < n;  ++i) {
+            const DistributedDatasetPartition & p = config.partitions[i];
+            queries[i] = makeQuery(quoteIdentifier(p.dataset));
+            if (p.uri.empty())
+                continue;
+            Utf8String uri = p.uri;
+            while (uri.endsWith("/"))
+                uri.removeSuffix("/");
+            urls.push_back((uri + "/v1/query?format=full&q="
+                            + encodeUriComponent(queries[i])).rawString());
+            urlPartitions.push_back(i);
+        }
+
+        auto onDone = [&] (size_t index, HttpBatchFetchResult & fetched)
+            {
+                size_t i = urlPartitions[index];
+                if (fetched.responseCode != 200) {
+                    throw AnnotatedException
+                        (500, "Error running query on partition of "
+                         "distributed dataset",
+                         "uri", config.partitions[i].uri,
+                         "dataset", config.partitions[i].dataset,
+                         "query", queries[i],
+                         "responseCode", fetched.responseCode,
+                         "error", fetched.responseCode == 0
+                         ? fetched.errorMessage
+                         : string(fetched.body, 0, 1024));
+                }
+                results[i] = jsonDecodeStr<std::vector<MatrixNamedRow> >
+                    (fetched.body);
+            };
+
+        if (!urls.empty()) {
+            HttpBatchFetchOptions options;
+            options.maxRetries = config.maxRetries;
+            httpBatchFetch(urls, options, onDone);
+        }
+
+        for (size_t i = 0;  i < n;  ++i) {
+            if (!config.partitions[i].uri.empty())
+                continue;
+            SqlExpressionMldbScope context(engine);
+            results[i] = queryFromStatement
+                (SelectStatement::parse(queries[i]), context);
+        }
+
+        return results;
+    }
+
+    /** Put the rows returned by the partitions into an in-memory dataset.
+        If rowNames is set, the rows are numbered in order and their names
+        are put there; otherwise they keep their names.
+    */
+    std::shared_ptr<Dataset>
+    gather(std::vector<std::vector<MatrixNamedRow> > results,
+           std::vector<RowPath> * rowNames = nullptr) const
+    {
+        auto result = std::make_shared<SubDataset>
+            (engine, std::vector<NamedRowValue>());
+
+        std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > rows;
+        for (auto & partition: results) {
+            for (auto & row: partition) {
+                if (rowNames) {
+                    rows.emplace_back(RowPath(PathElement(rowNames->size())),
+                                      std::move(row.columns));
+                    rowNames->emplace_back(std::move(row.rowName));
+                }
+                else {
+                    rows.emplace_back(std::move(row.rowName),
+                                      std::move(row.columns));
+                }
+            }
+        }
+        result->recordRows(rows);
+        return result;
+    }
+
+    /// Copy of all of the partitions, for operations other than queries
+    std::shared_ptr<Dataset> getCopy() const
+    {
+        std::unique_lock<std::mutex> guard(copyMutex);
+        if (!copy) {
+            copy = gather(scatter([] (const Utf8String & dataset)
+                                  {
+                                      return "SELECT * FROM " + dataset;
+                                  }));
+        }
+        return copy;
+    }
+
+    static Utf8String
+    getFromClause(const Utf8String & dataset, const Utf8String & alias)
+    {
+        Utf8String result = " FROM " + dataset;
+        if (!alias.empty())
+            result += " AS " + quoteIdentifier(alias);
+        return result;
+    }
+
+    static Utf8String
+    getWhenClause(const WhenExpression & when)
+    {
+        if (when.when->isConstantTrue())
+            return Utf8String();
+        return " WHEN " + getSurface(*when.when);
+    }
+
+    static Utf8String
+    getWhereClause(const SqlExpression & where)
+    {
+        if (where.isConstantTrue())
+            return Utf8String();
+        return " WHERE " + getSurface(where);
+    }
+
+    /** Query without aggregation.  Each partition returns the selected
+        rows in order, up to offset + limit of them, along with their
+        names and the values they're ordered by; the merge orders them
+        again and applies the offset and limit.
+    */
+    bool queryRows(std::function<bool (Path &, ExpressionValue &)> & onRow,
+                   const SelectExpression & select,
+                   const WhenExpression & when,
+                   const SqlExpression & where,
+                   const OrderByExpression & orderBy,
+                   const std::shared_ptr<SqlExpression> & rowName,
+                   ssize_t offset,
+                   ssize_t limit,
+                   const Utf8String & alias) const
+    {
+        std::vector<Utf8String> outputs;
+        outputs.push_back("{" + getSurface(select) + "} AS __row");
+
+        std::vector<Utf8String> orderClauses;
+        OrderByExpression mergeOrderBy;
+        for (size_t i = 0;  i < orderBy.clauses.size();  ++i) {
+            auto & clause = orderBy.clauses[i];
+            Utf8String column = indexedName("__o_", i);
+            outputs.push_back(getSurface(*clause.first) + " AS " + column);
+            orderClauses.push_back(getSurface(*clause.first)
+                                   + (clause.second == ASC ? " ASC" : " DESC"));
+            mergeOrderBy.clauses.emplace_back
+                (std::make_shared<ReadColumnExpression>(ColumnPath(column)),
+                 clause.second);
+        }
+
+        auto makeQuery = [&] (const Utf8String & dataset)
+            {
+                Utf8String result = "SELECT " + join(outputs)
+                    + " NAMED " + getSurface(*rowName)
+                    + getFromClause(dataset, alias)
+                    + getWhenClause(when)
+                    + getWhereClause(where);
+                if (!orderClauses.empty())
+                    result += " ORDER BY " + join(orderClauses);
+                if (limit != -1)
+                    result += " LIMIT " + to_string(offset + limit);
+                return result;
+            };
+
+        std::vector<RowPath> rowNames;
+        auto gathered = gather(scatter(makeQuery), &rowNames);
+
+        std::function<bool (Path &, ExpressionValue &)> onMergedRow
+            = [&] (Path & row, ExpressionValue & val)
+            {
+                Path name = rowNames.at(row.at(0).toIndex());
+                return onRow(name, val);
+            };
+
+        return gathered->queryStructuredIncremental
+            (onMergedRow, SelectExpression::parse("__row.* AS *"),
+             WhenExpression::TRUE, *SqlExpression::TRUE,
+             mergeOrderBy, TupleExpression(), SqlExpression::TRUE,
+             SqlExpression::parse("rowPath()"), offset, limit);
+    }
+
+    /** Return the expression that merges the partial results of the
+        aggregator, adding the partial aggregates that the partitions
+        must calculate to outputs.  Returns null if the aggregator can't be
+        calculated in parts.
+    */
+    static std::shared_ptr<SqlExpression>
+    splitAggregator(const SqlExpression & aggregator,
+                    std::vector<Utf8String> & outputs)
+    {
+        auto fn = dynamic_cast<const FunctionCallExpression *>(&aggregator);
+        if (!fn || !fn->tableName.empty())
+            return nullptr;
+
+        Utf8String name = fn->functionName;
+        if (name.startsWith("vertical_"))
+            name.removePrefix("vertical_");
+
+        auto partial = [&] (const Utf8String & expr)
+            {
+                Utf8String column = indexedName("__a_", outputs.size());
+                outputs.push_back(expr + " AS " + column);
+                return column;
+            };
+
+        auto arg = [&] (size_t i)
+            {
+                return getSurface(*fn->args.at(i));
+            };
+
+        Utf8String merge;
+        if (name == "count" || name == "sum") {
+            merge = "sum(" + partial(getSurface(aggregator)) + ")";
+        }
+        else if (name == "min" || name == "max"
+                 || name == "earliest" || name == "latest") {
+            merge = name + "(" + partial(getSurface(aggregator)) + ")";
+        }
+        else if (name == "avg" && fn->args.size() == 1) {
+            Utf8String sum = partial("sum(" + arg(0) + ")");
+            Utf8String count = partial("count(" + arg(0) + ")");
+            merge = "sum(" + sum + ") / sum(" + count + ")";
+        }
+        else if (name == "approx_count_distinct" && fn->args.size() == 1) {
+            merge = "hll_estimate(hll_merge("
+                + partial("hll_sketch(" + arg(0) + ")") + "))";
+        }
+        else if (name == "hll_sketch" || name == "hll_merge") {
+            merge = "hll_merge(" + partial(getSurface(aggregator)) + ")";
+        }
+        else if (name == "approx_median" && fn->args.size() == 1) {
+            merge = "tdigest_quantile(tdigest_merge("
+                + partial("tdigest_sketch(" + arg(0) + ")") + "), 0.5)";
+        }
+        else if (name == "approx_quantile" && fn->args.size() == 2
+                 && fn->args[1]->isConstant()) {
+            merge = "tdigest_quantile(tdigest_merge("
+                + partial("tdigest_sketch(" + arg(0) + ")") + "), "
+                + arg(1) + ")";
+        }
+        else if (name == "tdigest_sketch" || name == "tdigest_merge") {
+            merge = "tdigest_merge(" + partial(getSurface(aggregator)) + ")";
+        }
+        else if (name == "approx_top_k" && fn->args.size() == 2) {
+            merge = "top_k_values(top_k_merge("
+                + partial("top_k_sketch(" + arg(0) + ", " + arg(1) + ")")
+                + "))";
+        }
+        else if (name == "top_k_sketch" || name == "top_k_merge") {
+            merge = "top_k_merge(" + partial(getSurface(aggregator)) + ")";
+        }
+        else return nullptr;
+
+        return SqlExpression::parse(merge);
+    }
+
+    /** Query with aggregation.  Each partition returns its groups, with
+        the value of the group keys and the partial aggregates, which are
+        then grouped again and merged.  Returns false without doing
+        anything if one of the aggregators can't be calculated in parts.
+    */
+    bool queryGrouped(std::function<bool (Path &, ExpressionValue &)> & onRow,
+                      const SelectExpression & select,
+                      const WhenExpression & when,
+                      const SqlExpression & where,
+                      const OrderByExpression & orderBy,
+                      const TupleExpression & groupBy,
+                      const std::shared_ptr<SqlExpression> & having,
+                      const std::shared_ptr<SqlExpression> & rowName,
+                      ssize_t offset,
+                      ssize_t limit,
+                      const Utf8String & alias,
+                      const std::vector<std::shared_ptr<SqlExpression> >
+                          & aggregators,
+                      bool & done) const
+    {
+        done = false;
+
+        std::vector<Utf8String> outputs;
+        std::vector<Utf8String> groupClauses;
+        std::map<Utf8String, std::shared_ptr<SqlExpression> > replacements;
+        TupleExpression mergeGroupBy;
+
+        for (size_t i = 0;  i < groupBy.clauses.size();  ++i) {
+            auto & clause = groupBy.clauses[i];
+            Utf8String column = indexedName("__g_", i);
+            outputs.push_back(getSurface(*clause) + " AS " + column);
+            groupClauses.push_back(getSurface(*clause));
+            auto read = std::make_shared<ReadColumnExpression>(ColumnPath(column));
+            read->surface = column;
+            replacements[clause->print()] = read;
+            mergeGroupBy.clauses.push_back(read);
+        }
+
+        for (auto & a: aggregators) {
+            Utf8String printed = a->print();
+            if (replacements.count(printed))
+                continue;
+            auto merge = splitAggregator(*a, outputs);
+            if (!merge)
+                return true;
+            replacements[printed] = merge;
+        }
+
+        auto makeQuery = [&] (const Utf8String & dataset)
+            {
+                Utf8String result = "SELECT " + join(outputs)
+                    + getFromClause(dataset, alias)
+                    + getWhenClause(when)
+                    + getWhereClause(where);
+                if (!groupClauses.empty())
+                    result += " GROUP BY " + join(groupClauses);
+                return result;
+            };
+
+        SelectExpression mergeSelect;
+        for (auto & clause: select.clauses) {
+            mergeSelect.clauses.push_back
+                (dynamic_pointer_cast<SqlRowExpression>
+                 (replaceForMerge(clause, replacements)));
+        }
+
+        OrderByExpression mergeOrderBy;
+        for (auto & clause: orderBy.clauses) {
+            mergeOrderBy.clauses.emplace_back
+                (replaceForMerge(clause.first, replacements), clause.second);
+        }
+
+        std::vector<RowPath> rowNames;
+        auto gathered = gather(scatter(makeQuery), &rowNames);
+
+        done = true;
+        return gathered->queryStructuredIncremental
+            (onRow, mergeSelect, WhenExpression::TRUE, *SqlExpression::TRUE,
+             mergeOrderBy, mergeGroupBy,
+             replaceForMerge(having, replacements),
+             replaceForMerge(rowName, replacements),
+             offset, limit);
+    }
+};
+
+
+/*****************************************************************************/
+/* DISTRIBUTED DATASET                                                       */
+/*****************************************************************************/
+
+DistributedDataset::
+DistributedDataset(MldbEngine * owner,
+                   PolyConfig config,
+                   const ProgressFunc & onProgress)
+    : Dataset(owner)
+{
+    datasetConfig = config.params.convert<DistributedDatasetConfig>();
+    itl.reset(new Itl(owner, datasetConfig));
+}
+
+DistributedDataset::
+~DistributedDataset()
+{
+}
+
+Any
+DistributedDataset::
+getStatus() const
+{
+    Json::Value result;
+    result["numPartitions"] = (int)datasetConfig.partitions.size();
+    return result;
+}
+
+std::shared_ptr<MatrixView>
+DistributedDataset::
+getMatrixView() const
+{
+    return itl->getCopy()->getMatrixView();
+}
+
+std::shared_ptr<ColumnIndex>
+DistributedDataset::
+getColumnIndex() const
+{
+    return itl->getCopy()->getColumnIndex();
+}
+
+std::shared_ptr<RowStream>
+DistributedDataset::
+getRowStream() const
+{
+    return itl->getCopy()->getRowStream();
+}
+
+std::pair<Date, Date>
+DistributedDataset::
+getTimestampRange() const
+{
+    return itl->getCopy()->getTimestampRange();
+}
+
+ExpressionValue
+DistributedDataset::
+getRowExpr(const RowPath & rowPath) const
+{
+    return itl->getCopy()->getRowExpr(rowPath);
+}
+
+bool
+DistributedDataset::
+queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onRow,
+                           const SelectExpression & select,
+                           const WhenExpression & when,
+                           const SqlExpression & where,
+                           const OrderByExpression & orderBy,
+                           const TupleExpression & groupBy,
+                           const std::shared_ptr<SqlExpression> having,
+                           const std::shared_ptr<SqlExpression> rowName,
+                           ssize_t offset,
+                           ssize_t limit,
+                           Utf8String alias,
+                           const ProgressFunc & onProgress) const
+{
+    if (!having->isConstantTrue() && groupBy.clauses.empty())
+        throw AnnotatedException
+            (400, "HAVING expression requires a GROUP BY expression");
+
+    bool grouped = !groupBy.clauses.empty();
+    auto aggregators = select.findAggregators(grouped);
+    for (auto & a: findAggregators(having, grouped))
+        aggregators.push_back(a);
+    for (auto & a: orderBy.findAggregators(grouped))
+        aggregators.push_back(a);
+    for (auto & a: findAggregators(rowName, grouped))
+        aggregators.push_back(a);
+
+    if (select.distinctExpr.empty()) {
+        if (!grouped && aggregators.empty()) {
+            return itl->queryRows(onRow, select, when, where, orderBy,
+                                  rowName, offset, limit, alias);
+        }
+
+        bool done;
+        bool result = itl->queryGrouped(onRow, select, when, where, orderBy,
+                                        groupBy, having, rowName, offset,
+                                        limit, alias, aggregators, done);
+        if (done)
+            return result;
+    }
+
+    // The query can't be split, so the partitions only filter the rows
+    // and the rest is done here.  The WHEN clause isn't sent, as the WHERE
+    // clause is run again here and needs to see the same values.
+    auto makeQuery = [&] (const Utf8String & dataset)
+        {
+            return "SELECT * NAMED rowPath()"
+                + Itl::getFromClause(dataset, alias)
+                + Itl::getWhereClause(where);
+        };
+
+    auto gathered = itl->gather(itl->scatter(makeQuery));
+    return gathered->queryStructuredIncremental
+        (onRow, select, when, where, orderBy, groupBy, having, rowName,
+         offset, limit, alias, onProgress);
+}
+
+} // namespace MLDB
@@ -0,0 +1,93 @@
+/** distributed_dataset.h                                         -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Dataset whose rows are partitioned over several MLDB instances, and
+    whose queries are run on each of them before the results are merged.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/types/value_description_fwd.h"
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* DISTRIBUTED DATASET CONFIG                                                */
+/*****************************************************************************/
+
+struct DistributedDatasetPartition {
+    Utf8String uri;
+    Utf8String dataset;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(DistributedDatasetPartition);
+
+struct DistributedDatasetConfig {
+    std::vector<DistributedDatasetPartition> partitions;
+    int maxRetries = 0;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(DistributedDatasetConfig);
+
+
+/*****************************************************************************/
+/* DISTRIBUTED DATASET                                                       */
+/*****************************************************************************/
+
+/** Dataset made of partitions that each live in a dataset of an MLDB
+    instance, which is either this one or a peer reached through its
+    REST interface.
+
+    Queries are split into a part that is sent as SQL to each partition
+    (WHEN, WHERE, the projection, and the partial aggregates of a GROUP BY)
+    and a part that merges the results on this instance (final aggregates,
+    HAVING, ORDER BY, OFFSET and LIMIT).  Anything else that reads the
+    dataset works over a copy of all of the partitions, made the first
+    time it's needed.
+*/
+struct DistributedDataset: public Dataset {
+
+    DistributedDataset(MldbEngine * owner,
+                       PolyConfig config,
+                       const ProgressFunc & onProgress);
+
+    virtual ~DistributedDataset() override;
+
+    virtual Any getStatus() const override;
+    virtual void recordRowItl(const RowPath & rowPath,
+        const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals) override
+    {
+        throw MLDB::Exception("Dataset type doesn't allow recording");
+    }
+
+    virtual std::shared_ptr<MatrixView> getMatrixView() const override;
+    virtual std::shared_ptr<ColumnIndex> getColumnIndex() const override;
+    virtual std::shared_ptr<RowStream> getRowStream() const override;
+
+    virtual std::pair<Date, Date> getTimestampRange() const override;
+    virtual ExpressionValue getRowExpr(const RowPath & rowPath) const override;
+
+    /** Scatter the query to the partitions and gather their results. */
+    virtual bool
+    queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onRow,
+                               const SelectExpression & select,
+                               const WhenExpression & when,
+                               const SqlExpression & where,
+                               const OrderByExpression & orderBy,
+                               const TupleExpression & groupBy,
+                               const std::shared_ptr<SqlExpression> having,
+                               const std::shared_ptr<SqlExpression> rowName,
+                               ssize_t offset,
+                               ssize_t limit,
+                               Utf8String alias = "",
+                               const ProgressFunc & onProgress = nullptr) const override;
+
+private:
+    DistributedDatasetConfig datasetConfig;
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
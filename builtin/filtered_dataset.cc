@@ -258,5 +258,12 @@ getColumnIndex() const
     return itl;
 }
 
+std::shared_ptr<RowStream>
+FilteredDataset::
+getRowStream() const
+{
+    return dataset.getRowStream();
+}
+
 } // namespace MLDB
 
@@ -50,6 +50,9 @@ struct FilteredDataset : public Dataset {
     virtual std::shared_ptr<MatrixView> getMatrixView() const;
     virtual std::shared_ptr<ColumnIndex> getColumnIndex() const;
 
+    /// The filter is on values, so the rows are those of the dataset
+    virtual std::shared_ptr<RowStream> getRowStream() const;
+
     // TODO: if often used, this could be reasonably overridden here
     //virtual std::pair<Date, Date> getTimestampRange() const;
 
@@ -9,7 +9,7 @@
 
 #pragma once
 
-#include "mldb/utils/lightweight_hash.h"
+#include "mldb/utils/swiss_hash.h"
 
 namespace MLDB {
 
@@ -39,111 +39,29 @@ operator << (std::ostream & stream, const IdHashBucket & bucket)
     return stream << "(" << bucket.first << "," <<  bucket.second << ")";
 }
 
-struct IdHashFn {
-    size_t operator () (uint64_t val) MLDB_CONST_FN
-    {
-        return val;
-    }
-};
-
-struct IdHashOps : public PairOps<uint64_t, uint32_t, IdHashFn, IdHashBucket> {
-
-    template<typename Storage>
-    static size_t hashKey(IdHashBucket bucket, int capacity,
-                          const Storage & storage)
-    {
-        return hashKey(getKey(bucket), capacity, storage);
-    }
+/** Hash function for an IdHash.  The keys are already hashes, so they are
+    used directly, except that the top RESERVEDBUCKETBITS (which choose the
+    IdHashes bucket, and so are the same for every key of an IdHash) are
+    shifted out.  The table takes its position from the high bits of the
+    result, so keys are placed in roughly the order they would have if
+    sorted, which keeps accesses in sorted order (such as inserting a merged
+    list of hashes) local.  The low bits aren't used; they are often used to
+    partition rows when sharding, and so have little entropy.
+*/
 
-    template<typename Storage>
-    static size_t hashKey(uint64_t key, int capacity, const Storage & storage)
+struct IdHashFn {
+    uint64_t operator () (uint64_t key) const
     {
-#if 0
-        // Take the middle bits
-        key >>= 32;
-        return key % capacity;
-        //uint64_t mask = (1ULL << ((storage.bits_ - 1))) - 1;
-        //return key & mask;
-#elif 0
-        //key >>= 32;
-        uint64_t mask = (1ULL << ((storage.bits_ - 1))) - 1;
-        return key & mask;
-
-#elif 1
-        /* This hashing scheme is designed to put elements in buckets roughly
-           in the order that they would occur when sorted in an array.
-
-           If we look at the hash, we get:
-
-           64     64-RBB                       n          0
-           V      V                            v          v
-           +------+---------+------------------+-----------+
-           | bct  | hash    |                  | partition |
-           +------+---------+------------------+-----------+
-              1        2             3              4
-             
-           1.  The top RBB (RESERVEDBUCKETBITS) are used to divide the
-               ID space into a lot of "buckets", each of which is hashed
-               individually.  The goal of this is to squeeze all accesses
-               of nearby hashes into the same segment of memory, and to
-               allow initialization of each bucket to happen in paralle1.
-           2.  The next bits (storage.bits_) are used as the result of the
-               hash function.  This hash function has the interesting
-               property of keeping the order of buckets very similar to
-               the order of the sorted keys, which helps with locality of
-               reference when accessing keys in sorted order.
-           3.  These bits have no special use.
-           4.  The lower bits of the hash are used to partition users
-               when sharding.  This means that you cannot rely on these
-               bits having any entropy; often the first n bits will all
-               have the same value.  Common values of n are 1-6.  This
-               is one reason why we hash on the higher bits rather than the
-               lower bits.
-        */
-
-        // 1.  Clear out the top bits that are reserved for the bucket
-        uint64_t key2 = (key << RESERVEDBUCKETBITS) >> RESERVEDBUCKETBITS;
-
-        // 2.  Shift out everything except enough high order bits to cover
-        //     the entire bucket range.
-        uint64_t shift = 65ULL - RESERVEDBUCKETBITS - storage.bits_;
-        uint64_t res = key2 >> shift;
-        return res;
-
-        using namespace std;
-        cerr << MLDB::format("key = %016llx res = %016llx",
-                           (unsigned long long)key,
-                           (unsigned long long)res)
-             << endl;
-#elif 0
-        // Replace a div with a shift
-        uint64_t mask = (1ULL << ((storage.bits_ - 1))) - 1;
-        return key & mask;
-
-#elif 0
-        // Non-improved version
-        return key % capacity;
-#endif
+        return key << RESERVEDBUCKETBITS;
     }
-    
 };
 
-#if 1
-typedef LightweightHash<uint64_t,
-                             uint32_t,
-                             IdHashBucket,
-                             IdHashBucket,
-                             IdHashOps,
-                             LogMemStorage<IdHashBucket> > 
-IdHash;
-#else
-typedef LightweightHash<uint64_t,
-                             uint32_t,
-                             IdHashBucket,
-                             IdHashBucket,
-                             IdHashOps>
+typedef SwissHash<uint64_t,
+                  uint32_t,
+                  IdHashBucket,
+                  IdHashBucket,
+                  IdHashFn>
 IdHash;
-#endif
 
 struct IdHashes {
     enum {
@@ -210,7 +128,14 @@ struct IdHashes {
 
         }
 
-        const_iterator(const IdHashes* source) : source(source), bucket(0)
+        const_iterator(const IdHashes* source) : const_iterator(source, 0)
+        {
+        }
+
+        /// Iterator at the first entry of the given bucket, or of the
+        /// first non-empty bucket after it
+        const_iterator(const IdHashes* source, size_t bucket)
+            : source(source), bucket(bucket)
         {
             bucketIter = source->buckets[bucket].begin();
             while (bucketIter == source->buckets[bucket].end())
@@ -224,7 +149,7 @@ struct IdHashes {
         }
         IdHashBucket operator *() const
         {
-            return bucketIter.dereference();
+            return *bucketIter;
         }
         void operator ++()
         {
@@ -11,7 +11,7 @@
 #include "mldb/sql/sql_expression.h"
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/sql/execution_pipeline_impl.h"
-#include "mldb/utils/lightweight_hash.h"
+#include "mldb/utils/swiss_hash.h"
 #include "mldb/utils/profile.h"
 #include "mldb/sql/join_utils.h"
 #include "mldb/types/any_impl.h"
@@ -21,7 +21,17 @@
 #include "mldb/types/hash_wrapper_description.h"
 #include "mldb/utils/compact_vector.h"
 #include "mldb/engine/dataset_utils.h"
+#include "mldb/base/parallel.h"
+#include "mldb/core/mldb_engine.h"
+#include "mldb/engine/query_result_cache.h"
+#include "mldb/types/db/file_read_buffer.h"
+#include "mldb/ext/cityhash/src/city.h"
 #include <functional>
+#include <limits>
+#include <list>
+#include <fstream>
+#include <unistd.h>
+#include <stdio.h>
 
 using namespace std;
 using namespace std::placeholders;
@@ -51,9 +61,24 @@ JoinedDatasetConfigDescription()
              "Type of join");
 }
 
-struct JoinedDataset::Itl
-    : public MatrixView, public ColumnIndex {
+/*****************************************************************************/
+/* JOIN CACHE                                                                */
+/*****************************************************************************/
+
+Utf8String getJoinCacheDirectory()
+{
+    const char * dir = getenv("MLDB_JOIN_CACHE_DIR");
+    if (!dir)
+        return Utf8String();
+    return dir;
+}
+
+namespace {
 
+/** The rows of a join.  These are shared between all of the joined
+    datasets that do the same join on the same data.
+*/
+struct JoinRows {
     struct RowEntry {
         RowHash rowHash;   ///< Row hash of joined row
         RowPath rowName;   ///< Name of joined row
@@ -61,6 +86,219 @@ struct JoinedDataset::Itl
         //compact_vector<RowHash, 2> rowHashes;   ///< Row hash from input datasets
     };   
 
+    /// Rows in the joined dataset
+    std::vector<RowEntry> rows;
+
+    /// Map from row hash to the row
+    SwissHash<RowHash, int64_t> rowIndex;
+
+    /// Index of a row hash for a left or right dataset to a list of
+    /// rows it's part of in the output.
+    typedef std::map<RowHash, compact_vector<RowPath, 1> > SideRowIndex;
+
+    /// Left row hash to list of row hashes it's present in for colummn index
+    SideRowIndex leftRowIndex;
+
+    /// Right row hash to list of row hashes it's present in for colummn index
+    SideRowIndex rightRowIndex;
+};
+
+/// Value joined on, name and hash of each row of one side of a join
+typedef std::vector<std::tuple<ExpressionValue, RowPath, RowHash> >
+    JoinSideRows;
+
+/** What is read from one side of a join: the rows that can be joined,
+    and those (for an outer join) that can't but are output anyway.
+*/
+struct JoinSideValues {
+    JoinSideRows rows;
+    std::vector<std::tuple<RowPath, RowHash> > outerRows;
+};
+
+/// Datasets that a cached value was computed from, with their generation
+typedef std::vector<std::pair<std::weak_ptr<Dataset>, uint64_t> >
+    DatasetGenerations;
+
+/** Least recently used cache of values that were computed from datasets.
+    An entry is only returned while the catalog and the data generation of
+    each of the datasets it depends on are the same as when it was put.
+*/
+template<typename Value>
+struct GenerationCache {
+    GenerationCache(size_t maxEntries)
+        : maxEntries(maxEntries)
+    {
+    }
+
+    /** Return the value under the key, or null if there is none that is
+        still current.  If dependencies is given, the datasets the value
+        was computed from are put there.
+    */
+    std::shared_ptr<const Value>
+    get(const Utf8String & key, uint64_t catalogGeneration,
+        DatasetGenerations * dependencies = nullptr)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = index.find(key);
+        if (it == index.end())
+            return nullptr;
+        if (!isCurrent(*it->second, catalogGeneration)) {
+            entries.erase(it->second);
+            index.erase(it);
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        if (dependencies)
+            *dependencies = it->second->datasets;
+        return it->second->value;
+    }
+
+    void put(const Utf8String & key, uint64_t catalogGeneration,
+             DatasetGenerations datasets,
+             std::shared_ptr<const Value> value)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            entries.erase(it->second);
+            index.erase(it);
+        }
+        entries.push_front({ key, catalogGeneration, std::move(datasets),
+                             std::move(value) });
+        index[key] = entries.begin();
+        while (entries.size() > maxEntries) {
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+    }
+
+    size_t size() const
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        return entries.size();
+    }
+
+private:
+    struct Entry {
+        Utf8String key;
+        uint64_t catalogGeneration;
+        DatasetGenerations datasets;
+        std::shared_ptr<const Value> value;
+    };
+
+    static bool isCurrent(const Entry & entry, uint64_t catalogGeneration)
+    {
+        if (entry.catalogGeneration != catalogGeneration)
+            return false;
+        for (auto & d: entry.datasets) {
+            auto dataset = d.first.lock();
+            if (!dataset || dataset->getDataGeneration() != d.second)
+                return false;
+        }
+        return true;
+    }
+
+    size_t maxEntries;
+    mutable std::mutex mutex;
+    std::list<Entry> entries;   ///< Most recently used first
+    std::unordered_map<Utf8String, typename std::list<Entry>::iterator> index;
+};
+
+/** The join results and join sides that are kept around, so that joining
+    the same data again doesn't need to redo the work.
+*/
+struct JoinCache {
+    GenerationCache<JoinRows> joins{16};
+    GenerationCache<JoinSideValues> sides{16};
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> incremental{0};
+    std::atomic<uint64_t> diskHits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> uncacheable{0};
+
+    static JoinCache & instance()
+    {
+        static JoinCache result;
+        return result;
+    }
+};
+
+/// Identifies a dataset object within the cache keys.  A dataset that is
+/// replaced by another under the same name gets a different key.
+Utf8String datasetKey(const Dataset * dataset)
+{
+    return MLDB::format("%p", (const void *)dataset);
+}
+
+/** Header of a file in the join cache directory.  It is followed by one
+    JoinMappingEntry for each row of the join, in order.
+*/
+struct JoinMappingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;
+    uint64_t key;
+    uint64_t numRows;
+};
+
+struct JoinMappingEntry {
+    uint64_t leftHash;    ///< Hash of the left row, or 0 if there is none
+    uint64_t rightHash;   ///< Hash of the right row, or 0 if there is none
+};
+
+static const char JOIN_MAPPING_MAGIC[9] = "MLDBJOIN";
+static const uint32_t JOIN_MAPPING_VERSION = 1;
+
+/** Return a fingerprint of the content of the dataset that is the same
+    across restarts, or false if the dataset has none.  Only datasets that
+    were created from a configuration with an id are fingerprinted; the
+    fingerprint is made of the configuration and the hashes of the rows.
+*/
+bool getDatasetFingerprint(const Dataset & dataset, uint64_t & fingerprint)
+{
+    auto config = dataset.getConfigPtr();
+    if (!config || config->id.empty())
+        return false;
+
+    std::string configJson = jsonEncodeStr(*config);
+    uint64_t result = CityHash64(configJson.data(), configJson.size());
+
+    auto rowHashes = dataset.getMatrixView()->getRowHashes();
+    uint64_t sum = 0, xored = 0;
+    for (auto & h: rowHashes) {
+        sum += h.hash();
+        xored ^= h.hash();
+    }
+
+    result = Hash128to64({ result, rowHashes.size() });
+    result = Hash128to64({ result, Hash128to64({ sum, xored }) });
+    fingerprint = result;
+    return true;
+}
+
+} // file scope
+
+JoinCacheStats getJoinCacheStats()
+{
+    auto & cache = JoinCache::instance();
+    JoinCacheStats result;
+    result.entries = cache.joins.size();
+    result.sideEntries = cache.sides.size();
+    result.hits = cache.hits;
+    result.incremental = cache.incremental;
+    result.diskHits = cache.diskHits;
+    result.misses = cache.misses;
+    result.uncacheable = cache.uncacheable;
+    return result;
+}
+
+struct JoinedDataset::Itl
+    : public MatrixView, public ColumnIndex {
+
+    typedef JoinRows::RowEntry RowEntry;
+    typedef JoinRows::SideRowIndex SideRowIndex;
+
     struct JoinedRowStream : public RowStream {
 
         JoinedRowStream(JoinedDataset::Itl* source) : source(source)
@@ -74,7 +312,7 @@ struct JoinedDataset::Itl
         }
 
         virtual void initAt(size_t start){
-            iter = source->rows.begin() + start;
+            iter = source->joinRows->rows.begin() + start;
         }
 
         virtual const RowPath & rowName(RowPath & storage) const
@@ -95,21 +333,11 @@ struct JoinedDataset::Itl
         JoinedDataset::Itl* source;
     };
 
-    /// Rows in the joined dataset
-    std::vector<RowEntry> rows;
+    /// Rows of the join, which may be shared with other joined datasets
+    std::shared_ptr<const JoinRows> joinRows;
 
-    /// Map from row hash to the row
-    LightweightHash<RowHash, int64_t> rowIndex;
-
-    /// Index of a row hash for a left or right dataset to a list of
-    /// rows it's part of in the output.
-    typedef std::map<RowHash, compact_vector<RowPath, 1> > SideRowIndex;
-
-    /// Left row hash to list of row hashes it's present in for colummn index
-    SideRowIndex leftRowIndex;
-
-    /// Right row hash to list of row hashes it's present in for colummn index
-    SideRowIndex rightRowIndex;
+    /// Rows being recorded as the join is computed
+    std::shared_ptr<JoinRows> newRows;
 
     struct ColumnEntry {
         ColumnPath columnName;       ///< Name of the column in this dataset
@@ -215,6 +443,9 @@ struct JoinedDataset::Itl
         sideChildNames[JOIN_SIDE_LEFT]  = leftOps.getChildAliases();
         sideChildNames[JOIN_SIDE_RIGHT] = rightOps.getChildAliases();
       
+        // Until the join is done, there are no rows
+        joinRows = std::make_shared<JoinRows>();
+
         AnnotatedJoinCondition condition(leftExpr, rightExpr, on, 
                                          nullptr, //where
                                          qualification,
@@ -223,6 +454,13 @@ struct JoinedDataset::Itl
         if (debug)
             cerr << "Analyzed join condition: " << jsonEncode(condition) << endl;
 
+        // Identifies the join, without the datasets, for the join cache
+        Utf8String joinDescription
+            = leftExpr->print() + "\n" + rightExpr->print() + "\n"
+            + (on ? on->print() : Utf8String()) + "\n"
+            + std::to_string((int)qualification) + "\n"
+            + std::to_string(chainedJoinDepth);
+
         // Run the constant expression
         if (!condition.constantWhere->constantValue().isTrue()
             && qualification == JoinQualification::JOIN_INNER)
@@ -237,8 +475,13 @@ struct JoinedDataset::Itl
             
             // We can use a fast path, since we have simple non-filtered
             // equijoin
-            makeJoinConstantWhere(condition, scope, left, right,
-                                  qualification);            
+            auto compute = [&] ()
+                {
+                    return makeJoinConstantWhere(condition, scope, left, right,
+                                                 qualification);
+                };
+
+            joinRows = getJoinRows(scope, joinDescription, compute);
 
         } else {
 
@@ -262,13 +505,19 @@ struct JoinedDataset::Itl
                     throw AnnotatedException(400, "No parameters bound in");
                 };
 
-            PipelineElement::root(scope)
-                ->join(leftExpr, left, rightExpr, right, on, qualification)
-                ->select(SqlExpression::parse("leftRowPath()"))
-                ->select(SqlExpression::parse("rightRowPath()"))
-                ->bind()
-                ->start(getParam)
-                ->takeAll(gotElement);
+            auto compute = [&] ()
+                {
+                    PipelineElement::root(scope)
+                        ->join(leftExpr, left, rightExpr, right, on, qualification)
+                        ->select(SqlExpression::parse("leftRowPath()"))
+                        ->select(SqlExpression::parse("rightRowPath()"))
+                        ->bind()
+                        ->start(getParam)
+                        ->takeAll(gotElement);
+                    return 2;
+                };
+
+            joinRows = getJoinRows(scope, joinDescription, compute);
         }
 
         // Finally, the column indexes
@@ -318,12 +567,252 @@ struct JoinedDataset::Itl
 
         if (debug) {
             cerr << "total of " << columnIndex.size() << " columns and "
-                 << rows.size() << " rows returned from join" << endl;
+                 << joinRows->rows.size() << " rows returned from join" << endl;
                 
             cerr << jsonEncode(getColumnPaths(0, -1));
         }
     }
 
+    /** Return the rows of the join, from the join cache if the same join
+        of the same data was done before, and otherwise by calling
+        compute() to record them.  compute() returns how many of the two
+        sides it had to read from their datasets.
+    */
+    std::shared_ptr<const JoinRows>
+    getJoinRows(SqlBindingScope & scope,
+                const Utf8String & joinDescription,
+                const std::function<int ()> & compute)
+    {
+        auto & cache = JoinCache::instance();
+        MldbEngine * engine = scope.getMldbEngine();
+        uint64_t catalogGeneration
+            = engine ? engine->getCatalogGeneration() : 0;
+
+        // The generations are taken before anything is read, so that a
+        // change while the join is running makes its result stale
+        DatasetGenerations inputs = {
+            { leftDataset, leftDataset->getDataGeneration() },
+            { rightDataset, rightDataset->getDataGeneration() }
+        };
+
+        Utf8String key = joinDescription + "\n"
+            + datasetKey(leftDataset.get()) + "\n"
+            + datasetKey(rightDataset.get());
+
+        if (engine) {
+            DatasetGenerations dependencies;
+            auto result = cache.joins.get(key, catalogGeneration,
+                                          &dependencies);
+            if (result) {
+                ++cache.hits;
+                addToDependencyScope(dependencies);
+                return result;
+            }
+        }
+
+        Utf8String mappingFile;
+        uint64_t mappingKey = 0;
+        if (engine && getMappingKey(joinDescription, mappingKey)) {
+            mappingFile = getJoinCacheDirectory()
+                + MLDB::format("/join-%016llx.bin",
+                               (unsigned long long)mappingKey);
+            auto result = loadJoinMapping(mappingFile, mappingKey);
+            if (result) {
+                ++cache.diskHits;
+                cache.joins.put(key, catalogGeneration, inputs, result);
+                return result;
+            }
+        }
+
+        newRows = std::make_shared<JoinRows>();
+        int sidesRead;
+        bool cacheable;
+        DatasetGenerations dependencies = inputs;
+        {
+            QueryDependencyScope dependencyScope;
+            sidesRead = compute();
+            cacheable = dependencyScope.cacheable;
+            addDependencies(dependencies, dependencyScope.datasets);
+        }
+        std::shared_ptr<const JoinRows> result = std::move(newRows);
+
+        if (!engine)
+            return result;
+
+        if (sidesRead == 2)
+            ++cache.misses;
+        else if (sidesRead == 1)
+            ++cache.incremental;
+        else ++cache.hits;
+
+        if (!cacheable) {
+            ++cache.uncacheable;
+            return result;
+        }
+
+        cache.joins.put(key, catalogGeneration, dependencies, result);
+
+        // The files only know about the two datasets being joined
+        if (!mappingFile.empty() && dependencies.size() == inputs.size())
+            saveJoinMapping(mappingFile, mappingKey, *result);
+
+        return result;
+    }
+
+    /// Add the datasets in extra that aren't already in dependencies
+    static void addDependencies(DatasetGenerations & dependencies,
+                                const DatasetGenerations & extra)
+    {
+        for (auto & d: extra) {
+            auto dataset = d.first.lock();
+            bool found = false;
+            for (auto & e: dependencies)
+                found = found || e.first.lock() == dataset;
+            if (!found)
+                dependencies.push_back(d);
+        }
+    }
+
+    /// A query that contains a join whose result came from the cache still
+    /// depends on the datasets that the join read
+    static void addToDependencyScope(const DatasetGenerations & dependencies)
+    {
+        QueryDependencyScope * dependencyScope = QueryDependencyScope::current();
+        if (!dependencyScope)
+            return;
+        for (auto & d: dependencies)
+            dependencyScope->addDataset(d.first.lock());
+    }
+
+    /** Return the key of the join under which its row hashes are saved in
+        the join cache directory, or false if they're not saved.
+    */
+    bool getMappingKey(const Utf8String & joinDescription, uint64_t & key) const
+    {
+        if (getJoinCacheDirectory().empty())
+            return false;
+
+        uint64_t leftFingerprint, rightFingerprint;
+        if (!getDatasetFingerprint(*leftDataset, leftFingerprint)
+            || !getDatasetFingerprint(*rightDataset, rightFingerprint))
+            return false;
+
+        key = Hash128to64({ CityHash64(joinDescription.rawData(),
+                                       joinDescription.rawLength()),
+                            Hash128to64({ leftFingerprint,
+                                          rightFingerprint }) });
+        return true;
+    }
+
+    /** Read back the rows of the join from the row hashes saved in the
+        given file.  Returns null if there is no such file or it can't be
+        used.
+    */
+    std::shared_ptr<const JoinRows>
+    loadJoinMapping(const Utf8String & filename, uint64_t key)
+    {
+        if (::access(filename.rawData(), R_OK) != 0)
+            return nullptr;
+
+        try {
+            File_Read_Buffer buffer(filename.rawString());
+
+            JoinMappingHeader header;
+            if (buffer.size() < sizeof(header))
+                return nullptr;
+            std::memcpy(&header, buffer.start(), sizeof(header));
+            if (std::memcmp(header.magic, JOIN_MAPPING_MAGIC, 8) != 0
+                || header.version != JOIN_MAPPING_VERSION
+                || header.entrySize != sizeof(JoinMappingEntry)
+                || header.key != key
+                || buffer.size() != sizeof(header)
+                                    + header.numRows * sizeof(JoinMappingEntry))
+                return nullptr;
+
+            const JoinMappingEntry * entries
+                = reinterpret_cast<const JoinMappingEntry *>
+                (buffer.start() + sizeof(header));
+
+            // Look the names up in parallel, then record them in order
+            auto leftView = leftDataset->getMatrixView();
+            auto rightView = rightDataset->getMatrixView();
+            std::vector<RowPath> leftNames(header.numRows);
+            std::vector<RowPath> rightNames(header.numRows);
+
+            auto getNames = [&] (size_t begin, size_t end)
+                {
+                    for (size_t i = begin;  i < end;  ++i) {
+                        RowHash leftHash(entries[i].leftHash);
+                        RowHash rightHash(entries[i].rightHash);
+                        if (leftHash != RowHash())
+                            leftNames[i] = leftView->getRowPath(leftHash);
+                        if (rightHash != RowHash())
+                            rightNames[i] = rightView->getRowPath(rightHash);
+                    }
+                };
+
+            parallelMapChunked(0, header.numRows, 4096, getNames);
+
+            newRows = std::make_shared<JoinRows>();
+            for (size_t i = 0;  i < header.numRows;  ++i) {
+                recordJoinRow(leftNames[i], RowHash(entries[i].leftHash),
+                              rightNames[i], RowHash(entries[i].rightHash));
+            }
+
+            std::shared_ptr<const JoinRows> result = std::move(newRows);
+            return result;
+        } catch (const std::exception & exc) {
+            cerr << "ignoring join cache file " << filename << ": "
+                 << exc.what() << endl;
+            newRows.reset();
+            return nullptr;
+        }
+    }
+
+    /** Save the row hashes of the join in the given file, so that they
+        can be read back after a restart.  Failing to do so doesn't stop
+        the join from being used.
+    */
+    static void saveJoinMapping(const Utf8String & filename, uint64_t key,
+                                const JoinRows & rows)
+    {
+        // Written to the side and renamed, so that a concurrent reader
+        // never sees part of a file
+        std::string tmpFilename
+            = filename.rawString() + MLDB::format(".tmp%d", (int)getpid());
+
+        try {
+            std::ofstream stream(tmpFilename, std::ios::binary);
+
+            JoinMappingHeader header;
+            std::memcpy(header.magic, JOIN_MAPPING_MAGIC, 8);
+            header.version = JOIN_MAPPING_VERSION;
+            header.entrySize = sizeof(JoinMappingEntry);
+            header.key = key;
+            header.numRows = rows.rows.size();
+            stream.write((const char *)&header, sizeof(header));
+
+            std::vector<JoinMappingEntry> entries;
+            entries.reserve(rows.rows.size());
+            for (auto & r: rows.rows) {
+                entries.push_back({ RowHash(r.leftName).hash(),
+                                    RowHash(r.rightName).hash() });
+            }
+            stream.write((const char *)entries.data(),
+                         entries.size() * sizeof(JoinMappingEntry));
+            stream.close();
+
+            if (!stream)
+                throw MLDB::Exception("couldn't write " + tmpFilename);
+            if (::rename(tmpFilename.c_str(), filename.rawData()) != 0)
+                throw MLDB::Exception(errno, "renaming " + tmpFilename);
+        } catch (const std::exception & exc) {
+            cerr << "couldn't save join cache file " << filename << ": "
+                 << exc.what() << endl;
+            ::unlink(tmpFilename.c_str());
+        }
+    }
+
      /* This is called to record a new entry from the join. */
     void recordJoinRow(const RowPath & leftName, RowHash leftHash,
                        const RowPath & rightName, RowHash rightHash)
@@ -369,21 +858,24 @@ struct JoinedDataset::Itl
         entry.rightName = rightName;
 
         if (debug)
-            cerr << "added entry number " << rows.size()
+            cerr << "added entry number " << newRows->rows.size()
                  << " named " << "("<< rowName <<")"
                  << " from left (" << leftName <<")"
                  << " and right (" << rightName <<")"
                  << endl;
 
-        rows.emplace_back(std::move(entry));
-        rowIndex[rowHash] = rows.size() - 1;
+        newRows->rows.emplace_back(std::move(entry));
+        newRows->rowIndex[rowHash] = newRows->rows.size() - 1;
 
-        leftRowIndex[leftHash].push_back(rowName);
-        rightRowIndex[rightHash].push_back(rowName);
+        newRows->leftRowIndex[leftHash].push_back(rowName);
+        newRows->rightRowIndex[rightHash].push_back(rowName);
     };
 
-    //Easiest case with constant Where
-    void makeJoinConstantWhere(AnnotatedJoinCondition& condition,
+    /** Easiest case with constant Where.  Returns how many of the two
+        sides had to be read from their dataset, rather than being found in
+        the join cache.
+    */
+    int makeJoinConstantWhere(AnnotatedJoinCondition& condition,
                                SqlBindingScope& scope,
                                BoundTableExpression& left,
                                BoundTableExpression& right,
@@ -393,14 +885,17 @@ struct JoinedDataset::Itl
         bool outerLeft = qualification == JOIN_LEFT || qualification == JOIN_FULL;
         bool outerRight = qualification == JOIN_RIGHT || qualification == JOIN_FULL;
 
+        auto & cache = JoinCache::instance();
+        MldbEngine * engine = scope.getMldbEngine();
+        uint64_t catalogGeneration
+            = engine ? engine->getCatalogGeneration() : 0;
+        int sidesRead = 0;
+
         // Where expressions for the left and right side
         auto runSide = [&] (const AnnotatedJoinCondition::Side & side,
-                            const Dataset & dataset,
-                            bool outer,
-                            const std::function<void (const RowPath&,
-                                                      const RowHash& )>
-                                & recordOuterRow)
-            -> std::vector<std::tuple<ExpressionValue, RowPath, RowHash> >
+                            const std::shared_ptr<Dataset> & dataset,
+                            bool outer)
+            -> std::shared_ptr<const JoinSideValues>
             {
                 auto sideCondition = side.where;
 
@@ -440,9 +935,35 @@ struct JoinedDataset::Itl
                 SelectExpression queryExpression;
                 queryExpression.clauses.push_back(rowExpression);
 
-                auto generator = dataset.queryBasic
-                (scope, queryExpression, side.when, *sideCondition, side.orderBy,
-                 0, -1);
+                // The same side of another join of the same dataset
+                // reads the same rows
+                Utf8String key = datasetKey(dataset.get()) + "\n"
+                    + queryExpression.print() + "\n" + side.when.print()
+                    + "\n" + sideCondition->print();
+
+                if (engine) {
+                    DatasetGenerations dependencies;
+                    auto result = cache.sides.get(key, catalogGeneration,
+                                                  &dependencies);
+                    if (result) {
+                        addToDependencyScope(dependencies);
+                        return result;
+                    }
+                }
+
+                ++sidesRead;
+
+                DatasetGenerations dependencies = {
+                    { dataset, dataset->getDataGeneration() }
+                };
+                QueryDependencyScope dependencyScope;
+
+                // The rows are joined by hashing the values, so they don't
+                // need to be sorted on them; ordering by row hash keeps the
+                // output deterministic.
+                auto generator = dataset->queryBasic
+                (scope, queryExpression, side.when, *sideCondition,
+                 OrderByExpression::ROWHASH, 0, -1);
 
                 // Because we know that our outer scope is an
                 // SqlExpressionMldbScope, we know that it takes an
@@ -457,8 +978,10 @@ struct JoinedDataset::Itl
                     cerr << "got rows " << jsonEncode(rows) << endl;
 
                 // Now we extract all values 
-                std::vector<std::tuple<ExpressionValue, RowPath, RowHash> > sorted;
-                std::vector<std::tuple<RowPath, RowHash> > outerRows;
+                auto result = std::make_shared<JoinSideValues>();
+                JoinSideRows & sorted = result->rows;
+                std::vector<std::tuple<RowPath, RowHash> > & outerRows
+                    = result->outerRows;
 
                 for (auto & r: rows) {
                     ExcAssertEqual(r.columns.size(), 1);
@@ -481,34 +1004,30 @@ struct JoinedDataset::Itl
                     sorted.emplace_back(value, r.rowName, r.rowHash);
                 }
 
-                parallelQuickSortRecursive(sorted);
                 parallelQuickSortRecursive(outerRows);
 
-                for (auto & r: outerRows) {
-                    recordOuterRow(std::get<0>(r), std::get<1>(r));
+                if (engine && dependencyScope.cacheable) {
+                    addDependencies(dependencies, dependencyScope.datasets);
+                    cache.sides.put(key, catalogGeneration,
+                                    std::move(dependencies), result);
                 }
 
-                return sorted;
+                return result;
             };
 
-        auto recordOuterLeft = [&] (const RowPath& rowPath, const RowHash& rowHash)
-        {
-            recordJoinRow(rowPath, rowHash, RowPath(), RowHash());
-        };
-
-        auto recordOuterRight = [&] (const RowPath& rowPath, const RowHash& rowHash)
-        {
-            recordJoinRow( RowPath(), RowHash(), rowPath, rowHash);
-        };
+        auto leftSide = runSide(condition.left, left.dataset, outerLeft);
+        auto rightSide = runSide(condition.right, right.dataset, outerRight);
 
-        std::vector<std::tuple<ExpressionValue, RowPath, RowHash> >
-            leftRows, rightRows;
+        for (auto & r: leftSide->outerRows) {
+            recordJoinRow(std::get<0>(r), std::get<1>(r), RowPath(), RowHash());
+        }
 
-        leftRows = runSide(condition.left, *left.dataset, outerLeft,
-                           recordOuterLeft);
+        for (auto & r: rightSide->outerRows) {
+            recordJoinRow(RowPath(), RowHash(), std::get<0>(r), std::get<1>(r));
+        }
 
-        rightRows = runSide(condition.right, *right.dataset, outerRight,
-                            recordOuterRight);
+        const JoinSideRows & leftRows = leftSide->rows;
+        const JoinSideRows & rightRows = rightSide->rows;
 
         switch (condition.style) {
         case AnnotatedJoinCondition::CROSS_JOIN: {
@@ -533,7 +1052,342 @@ struct JoinedDataset::Itl
                                       "condition", condition);
         }
 
-        // Finally, perform the join
+        // Finally, perform the join.  Values that are rows can't be hashed
+        // consistently with how they compare, so those joins are done by
+        // sorting both sides.
+        auto isAtom = [] (const std::tuple<ExpressionValue, RowPath, RowHash> & r)
+            {
+                return std::get<0>(r).isAtom() || std::get<0>(r).empty();
+            };
+        if (isRowNameJoin(condition)
+            && sortedByRowHash(leftRows) && sortedByRowHash(rightRows)) {
+            rowHashMergeJoin(leftRows, rightRows, qualification);
+        }
+        else if (std::all_of(leftRows.begin(), leftRows.end(), isAtom)
+                 && std::all_of(rightRows.begin(), rightRows.end(), isAtom)) {
+            hashJoin(leftRows, rightRows, qualification);
+        }
+        else {
+            sortMergeJoin(leftRows, rightRows, qualification);
+        }
+
+        return sidesRead;
+    }
+
+    /** Join the rows of the two sides, which match when their values are
+        equal, by hashing the values.  The smaller side is the build side:
+        its rows are put in tables partitioned by the hash of their value,
+        and the rows of the other side are looked up in the table for their
+        partition.  The partitions are built and probed in parallel.
+
+        The joined rows are recorded in the order of the left rows, and
+        the right rows within those; unmatched right rows for RIGHT and
+        FULL joins come last.
+    */
+    void hashJoin(const JoinSideRows & leftRows,
+                  const JoinSideRows & rightRows,
+                  JoinQualification qualification)
+    {
+        ExcAssertLess(leftRows.size(), std::numeric_limits<uint32_t>::max());
+        ExcAssertLess(rightRows.size(), std::numeric_limits<uint32_t>::max());
+
+        bool buildLeft = leftRows.size() < rightRows.size();
+        const JoinSideRows & build = buildLeft ? leftRows : rightRows;
+        const JoinSideRows & probe = buildLeft ? rightRows : leftRows;
+
+        static constexpr int PARTITION_BITS = 6;
+        static constexpr size_t NUM_PARTITIONS = 1 << PARTITION_BITS;
+        auto getPartition = [] (uint64_t hash)
+            {
+                return hash >> (64 - PARTITION_BITS);
+            };
+
+        // Null values never match, so they're left out of the partitions
+        struct HashedRow {
+            uint64_t hash;
+            uint32_t index;
+            bool operator < (const HashedRow & other) const
+            {
+                return hash < other.hash
+                    || (hash == other.hash && index < other.index);
+            }
+        };
+
+        bool parallel = build.size() + probe.size() > 10000;
+
+        auto partitionSide = [&] (const JoinSideRows & rows)
+            {
+                std::vector<uint64_t> hashes(rows.size());
+                auto doHash = [&] (size_t begin, size_t end)
+                    {
+                        for (size_t i = begin;  i < end;  ++i)
+                            hashes[i] = std::get<0>(rows[i]).hash();
+                    };
+                if (parallel)
+                    parallelMapChunked(0, rows.size(), 4096, doHash);
+                else doHash(0, rows.size());
+
+                std::vector<std::vector<HashedRow> > partitions(NUM_PARTITIONS);
+                for (size_t i = 0;  i < rows.size();  ++i) {
+                    if (std::get<0>(rows[i]).empty())
+                        continue;
+                    partitions[getPartition(hashes[i])]
+                        .push_back({ hashes[i], (uint32_t)i });
+                }
+                return partitions;
+            };
+
+        auto buildPartitions = partitionSide(build);
+        auto probePartitions = partitionSide(probe);
+
+        // Matching (left, right) row numbers for each partition, and which
+        // rows matched something.  Each row is in a single partition, so
+        // the matched flags are never written by two threads.
+        std::vector<std::vector<std::pair<uint32_t, uint32_t> > >
+            matches(NUM_PARTITIONS);
+        std::vector<uint8_t> leftMatched(leftRows.size());
+        std::vector<uint8_t> rightMatched(rightRows.size());
+
+        auto doPartition = [&] (size_t p)
+            {
+                std::vector<HashedRow> & table = buildPartitions[p];
+                std::sort(table.begin(), table.end());
+
+                for (const HashedRow & row: probePartitions[p]) {
+                    const ExpressionValue & value = std::get<0>(probe[row.index]);
+                    auto it = std::lower_bound(table.begin(), table.end(),
+                                               HashedRow{ row.hash, 0 });
+                    for (;  it != table.end() && it->hash == row.hash;  ++it) {
+                        if (std::get<0>(build[it->index]) != value)
+                            continue;
+                        uint32_t leftIndex = buildLeft ? it->index : row.index;
+                        uint32_t rightIndex = buildLeft ? row.index : it->index;
+                        matches[p].emplace_back(leftIndex, rightIndex);
+                        leftMatched[leftIndex] = rightMatched[rightIndex] = 1;
+                    }
+                }
+
+                // Free the memory as we go
+                std::vector<HashedRow>().swap(table);
+                std::vector<HashedRow>().swap(probePartitions[p]);
+            };
+
+        if (parallel)
+            parallelMap(0, NUM_PARTITIONS, doPartition);
+        else for (size_t p = 0;  p < NUM_PARTITIONS;  ++p)
+                 doPartition(p);
+
+        std::vector<std::pair<uint32_t, uint32_t> > allMatches;
+        for (auto & m: matches) {
+            allMatches.insert(allMatches.end(), m.begin(), m.end());
+            std::vector<std::pair<uint32_t, uint32_t> >().swap(m);
+        }
+        parallelQuickSortRecursive(allMatches);
+
+        recordMatches(leftRows, rightRows, allMatches, leftMatched,
+                      rightMatched, qualification);
+    }
+
+    /** Is the join on the row names of both sides, ie rowName() = rowName()
+        or rowPath() = rowPath()?  Rows with equal names have equal row
+        hashes, so these joins can be done on the row hashes.
+    */
+    static bool isRowNameJoin(const AnnotatedJoinCondition & condition)
+    {
+        auto getFunction = [] (const std::shared_ptr<SqlExpression> & expr)
+            -> Utf8String
+            {
+                auto call = std::dynamic_pointer_cast<FunctionCallExpression>
+                    (expr);
+                // A table name that's left refers to a table within a
+                // joined side, whose row names aren't those of the side
+                if (!call || !call->args.empty() || !call->tableName.empty())
+                    return Utf8String();
+                if (call->functionName == "rowName"
+                    || call->functionName == "rowPath")
+                    return call->functionName;
+                return Utf8String();
+            };
+
+        Utf8String leftFunction = getFunction(condition.left.selectExpression);
+        return condition.style == AnnotatedJoinCondition::EQUIJOIN
+            && !leftFunction.empty()
+            && leftFunction == getFunction(condition.right.selectExpression);
+    }
+
+    static bool sortedByRowHash(const JoinSideRows & rows)
+    {
+        auto hashLess = [] (const std::tuple<ExpressionValue, RowPath, RowHash> & r1,
+                            const std::tuple<ExpressionValue, RowPath, RowHash> & r2)
+            {
+                return std::get<2>(r1).hash() < std::get<2>(r2).hash();
+            };
+        return std::is_sorted(rows.begin(), rows.end(), hashLess);
+    }
+
+    /** Join the rows of two sides that are joined on their row names (see
+        isRowNameJoin()) and are both in row hash order, which is how
+        queryBasic() returns them.  Since matching rows have equal row
+        hashes, the sides are merged on the hashes, without hashing the
+        values or building tables.  The hash space is split into ranges
+        that are merged in parallel.
+
+        The joined rows are recorded in the same order as hashJoin().
+    */
+    void rowHashMergeJoin(const JoinSideRows & leftRows,
+                          const JoinSideRows & rightRows,
+                          JoinQualification qualification)
+    {
+        ExcAssertLess(leftRows.size(), std::numeric_limits<uint32_t>::max());
+        ExcAssertLess(rightRows.size(), std::numeric_limits<uint32_t>::max());
+
+        static constexpr int RANGE_BITS = 6;
+        static constexpr size_t NUM_RANGES = 1 << RANGE_BITS;
+
+        auto hashAt = [] (const JoinSideRows & rows, size_t i)
+            {
+                return std::get<2>(rows[i]).hash();
+            };
+
+        // Index of the first row in range r
+        auto rangeStart = [&] (const JoinSideRows & rows, size_t r) -> size_t
+            {
+                if (r == 0)
+                    return 0;
+                if (r == NUM_RANGES)
+                    return rows.size();
+                uint64_t bound = uint64_t(r) << (64 - RANGE_BITS);
+                size_t first = 0, last = rows.size();
+                while (first < last) {
+                    size_t mid = first + (last - first) / 2;
+                    if (hashAt(rows, mid) < bound)
+                        first = mid + 1;
+                    else last = mid;
+                }
+                return first;
+            };
+
+        // Each row is in a single range, so the matched flags are never
+        // written by two threads.
+        std::vector<std::vector<std::pair<uint32_t, uint32_t> > >
+            matches(NUM_RANGES);
+        std::vector<uint8_t> leftMatched(leftRows.size());
+        std::vector<uint8_t> rightMatched(rightRows.size());
+
+        auto doRange = [&] (size_t r)
+            {
+                size_t i = rangeStart(leftRows, r);
+                size_t iEnd = rangeStart(leftRows, r + 1);
+                size_t j = rangeStart(rightRows, r);
+                size_t jEnd = rangeStart(rightRows, r + 1);
+
+                while (i < iEnd && j < jEnd) {
+                    uint64_t h1 = hashAt(leftRows, i);
+                    uint64_t h2 = hashAt(rightRows, j);
+                    if (h1 < h2) {
+                        ++i;
+                        continue;
+                    }
+                    if (h2 < h1) {
+                        ++j;
+                        continue;
+                    }
+
+                    size_t i2 = i + 1;
+                    while (i2 < iEnd && hashAt(leftRows, i2) == h1)
+                        ++i2;
+                    size_t j2 = j + 1;
+                    while (j2 < jEnd && hashAt(rightRows, j2) == h1)
+                        ++j2;
+
+                    // Check the names themselves in case of a hash collision
+                    for (size_t i1 = i;  i1 < i2;  ++i1) {
+                        for (size_t j1 = j;  j1 < j2;  ++j1) {
+                            if (std::get<0>(leftRows[i1])
+                                != std::get<0>(rightRows[j1]))
+                                continue;
+                            matches[r].emplace_back(i1, j1);
+                            leftMatched[i1] = rightMatched[j1] = 1;
+                        }
+                    }
+
+                    i = i2;
+                    j = j2;
+                }
+            };
+
+        if (leftRows.size() + rightRows.size() > 10000)
+            parallelMap(0, NUM_RANGES, doRange);
+        else for (size_t r = 0;  r < NUM_RANGES;  ++r)
+                 doRange(r);
+
+        // The ranges are in order, and so are the matches within them
+        std::vector<std::pair<uint32_t, uint32_t> > allMatches;
+        for (auto & m: matches) {
+            allMatches.insert(allMatches.end(), m.begin(), m.end());
+            std::vector<std::pair<uint32_t, uint32_t> >().swap(m);
+        }
+
+        recordMatches(leftRows, rightRows, allMatches, leftMatched,
+                      rightMatched, qualification);
+    }
+
+    /** Record the joined rows, given the (left, right) row numbers of the
+        matches in order, in the order of the left rows, and the right rows
+        within those; unmatched right rows for RIGHT and FULL joins come
+        last.
+    */
+    void recordMatches(const JoinSideRows & leftRows,
+                       const JoinSideRows & rightRows,
+                       const std::vector<std::pair<uint32_t, uint32_t> > & allMatches,
+                       const std::vector<uint8_t> & leftMatched,
+                       const std::vector<uint8_t> & rightMatched,
+                       JoinQualification qualification)
+    {
+        bool outerLeft = qualification == JOIN_LEFT || qualification == JOIN_FULL;
+        bool outerRight = qualification == JOIN_RIGHT || qualification == JOIN_FULL;
+
+        auto m = allMatches.begin();
+        for (uint32_t i = 0;  i < leftRows.size();  ++i) {
+            const RowPath & leftName = std::get<1>(leftRows[i]);
+            const RowHash & leftHash = std::get<2>(leftRows[i]);
+            if (!leftMatched[i]) {
+                if (outerLeft)
+                    recordJoinRow(leftName, leftHash, RowPath(), RowHash());
+                continue;
+            }
+            for (;  m != allMatches.end() && m->first == i;  ++m) {
+                recordJoinRow(leftName, leftHash,
+                              std::get<1>(rightRows[m->second]),
+                              std::get<2>(rightRows[m->second]));
+            }
+        }
+
+        if (outerRight) {
+            for (uint32_t i = 0;  i < rightRows.size();  ++i) {
+                if (!rightMatched[i])
+                    recordJoinRow(RowPath(), RowHash(),
+                                  std::get<1>(rightRows[i]),
+                                  std::get<2>(rightRows[i]));
+            }
+        }
+    }
+
+    /** Join the rows of the two sides by sorting both on their values and
+        merging them.  The sides are copied, since those in the join cache
+        are shared.
+    */
+    void sortMergeJoin(JoinSideRows leftRows,
+                       JoinSideRows rightRows,
+                       JoinQualification qualification)
+    {
+        bool debug = false;
+        bool outerLeft = qualification == JOIN_LEFT || qualification == JOIN_FULL;
+        bool outerRight = qualification == JOIN_RIGHT || qualification == JOIN_FULL;
+
+        parallelQuickSortRecursive(leftRows);
+        parallelQuickSortRecursive(rightRows);
+
         // We keep a list of the row hashes of those that join up
         auto it1 = leftRows.begin(), end1 = leftRows.end();
         auto it2 = rightRows.begin(), end2 = rightRows.end();
@@ -633,8 +1487,11 @@ struct JoinedDataset::Itl
     {
         std::vector<RowPath> result;
 
-        for (auto & r: rows) {
-            result.push_back(r.rowName);
+        const auto & rows = joinRows->rows;
+        size_t end = limit == -1
+            ? rows.size() : std::min<size_t>(rows.size(), start + limit);
+        for (size_t i = start;  i < end;  ++i) {
+            result.push_back(rows[i].rowName);
         }
 
         return result;
@@ -645,8 +1502,11 @@ struct JoinedDataset::Itl
     {
         std::vector<RowHash> result;
 
-        for (auto & r: rows) {
-            result.push_back(r.rowHash);
+        const auto & rows = joinRows->rows;
+        size_t end = limit == -1
+            ? rows.size() : std::min<size_t>(rows.size(), start + limit);
+        for (size_t i = start;  i < end;  ++i) {
+            result.push_back(rows[i].rowHash);
         }
 
         //cerr << "getRowHashes returned " << result.size() << " rows" << endl;
@@ -656,21 +1516,21 @@ struct JoinedDataset::Itl
 
     virtual bool knownRow(const RowPath & rowName) const
     {
-        return rowIndex.count(rowName);
+        return joinRows->rowIndex.count(rowName);
     }
 
     virtual bool knownRowHash(const RowHash & rowHash) const
     {
-        return rowIndex.count(rowHash);
+        return joinRows->rowIndex.count(rowHash);
     }
 
     virtual MatrixNamedRow getRow(const RowPath & rowName) const
     {
-        auto it = rowIndex.find(rowName);
-        if (it == rowIndex.end())
+        auto it = joinRows->rowIndex.find(rowName);
+        if (it == joinRows->rowIndex.end())
             return MatrixNamedRow();
         
-        const RowEntry & row = rows.at(it->second);
+        const RowEntry & row = joinRows->rows.at(it->second);
 
         if (rowName != row.rowName)
             return MatrixNamedRow();
@@ -718,11 +1578,11 @@ struct JoinedDataset::Itl
     {
         StructValue result;
 
-        auto it = rowIndex.find(rowName);
-        if (it == rowIndex.end())
+        auto it = joinRows->rowIndex.find(rowName);
+        if (it == joinRows->rowIndex.end())
             return result;
 
-        const RowEntry & row = rows.at(it->second);
+        const RowEntry & row = joinRows->rows.at(it->second);
         if (rowName != row.rowName)
             return result;
 
@@ -771,12 +1631,12 @@ struct JoinedDataset::Itl
 
     virtual RowPath getRowPath(const RowHash & rowHash) const
     {
-        auto it = rowIndex.find(rowHash);
-        if (it == rowIndex.end())
+        auto it = joinRows->rowIndex.find(rowHash);
+        if (it == joinRows->rowIndex.end())
             throw AnnotatedException(500, "Joined dataset did not find row with given hash",
                                       "rowHash", rowHash);
 
-        const RowEntry & row = rows.at(it->second);
+        const RowEntry & row = joinRows->rows.at(it->second);
 
         return row.rowName;
     }
@@ -862,10 +1722,10 @@ struct JoinedDataset::Itl
 
         if (it->second.bitmap == 1) {
             // on the left
-            result = doGetColumn(*leftDataset, leftRowIndex, it->second.childColumnName);
+            result = doGetColumn(*leftDataset, joinRows->leftRowIndex, it->second.childColumnName);
         }
         else {
-            result = doGetColumn(*rightDataset, rightRowIndex, it->second.childColumnName);
+            result = doGetColumn(*rightDataset, joinRows->rightRowIndex, it->second.childColumnName);
         }
 
         result.columnHash = result.columnName = it->second.columnName;
@@ -875,7 +1735,7 @@ struct JoinedDataset::Itl
 
     virtual size_t getRowCount() const
     {
-        return rowIndex.size();
+        return joinRows->rowIndex.size();
     }
 
     virtual size_t getColumnCount() const
@@ -887,12 +1747,12 @@ struct JoinedDataset::Itl
     {   
         ExcAssert(side < JOIN_SIDE_MAX);
         RowHash rowHash(name);
-        auto iter = rowIndex.find(rowHash);
-        if (iter == rowIndex.end())
+        auto iter = joinRows->rowIndex.find(rowHash);
+        if (iter == joinRows->rowIndex.end())
             return RowPath();
 
         int64_t index = iter->second;
-        const RowEntry& entry = rows[index];
+        const RowEntry& entry = joinRows->rows[index];
 
         return JOIN_SIDE_LEFT == side ? entry.leftName : entry.rightName;
     };
@@ -911,13 +1771,13 @@ struct JoinedDataset::Itl
     {
         ExcAssert(side < JOIN_SIDE_MAX);
         RowHash rowHash(name);
-        auto iter = rowIndex.find(rowHash);
-        if (iter == rowIndex.end())
+        auto iter = joinRows->rowIndex.find(rowHash);
+        if (iter == joinRows->rowIndex.end())
             return RowPath();
    
 
         int64_t index = iter->second;
-        const RowEntry& entry = rows[index];
+        const RowEntry& entry = joinRows->rows[index];
 
         RowPath subRowPath = JOIN_SIDE_LEFT == side ? entry.leftName : entry.rightName;
 
@@ -1225,7 +2085,10 @@ overrideFunction(const Utf8String & tableName,
                 {
                     auto & row = scope.as<SqlExpressionDatasetScope::RowScope>();
                     RowHash rowHash(row.getRowHash());
-                    return ExpressionValue(itl->rows[itl->rowIndex[rowHash]].leftName, Date::negativeInfinity());
+                    auto it = itl->joinRows->rowIndex.find(rowHash);
+                    if (it == itl->joinRows->rowIndex.end())
+                        return ExpressionValue::null(Date::negativeInfinity());
+                    return ExpressionValue(itl->joinRows->rows[it->second].leftName, Date::negativeInfinity());
                 },
                 std::make_shared<Utf8StringValueInfo>()
             };
@@ -1236,7 +2099,10 @@ overrideFunction(const Utf8String & tableName,
                 {
                     auto & row = scope.as<SqlExpressionDatasetScope::RowScope>();
                     RowHash rowHash(row.getRowHash());
-                    return ExpressionValue(itl->rows[itl->rowIndex[rowHash]].rightName, Date::negativeInfinity());
+                    auto it = itl->joinRows->rowIndex.find(rowHash);
+                    if (it == itl->joinRows->rowIndex.end())
+                        return ExpressionValue::null(Date::negativeInfinity());
+                    return ExpressionValue(itl->joinRows->rows[it->second].rightName, Date::negativeInfinity());
                 },
                 std::make_shared<Utf8StringValueInfo>()
             };
@@ -31,6 +31,46 @@ struct JoinedDatasetConfig {
 DECLARE_STRUCTURE_DESCRIPTION(JoinedDatasetConfig);
 
 
+/*****************************************************************************/
+/* JOIN CACHE                                                                */
+/*****************************************************************************/
+
+/** Statistics about the reuse of the rows of joined datasets.
+
+    The rows of a materialized join are kept in memory after they're
+    computed.  The same join of the same datasets reuses them until the
+    data generation of either dataset changes.  The values that each side
+    is joined on are kept as well.  So when only one of the datasets
+    changes, only that side is read again.
+
+    If the MLDB_JOIN_CACHE_DIR environment variable names a directory, the
+    joined pairs of row hashes are also written there.  They're read back
+    by the same join after a restart.  Those files are keyed by the
+    configuration, row count and row hashes of the two datasets.  A
+    dataset whose values change without any of those changing would make
+    them stale; in that case, clear the directory.
+*/
+
+struct JoinCacheStats {
+    size_t entries = 0;         ///< Joins whose rows are in memory
+    size_t sideEntries = 0;     ///< Join sides whose values are in memory
+    uint64_t hits = 0;          ///< Joins whose rows were reused
+    uint64_t incremental = 0;   ///< Joins where only one side was read
+    uint64_t diskHits = 0;      ///< Joins read from the cache directory
+    uint64_t misses = 0;        ///< Joins computed from scratch
+    uint64_t uncacheable = 0;   ///< Joins that call non-deterministic code
+};
+
+/// Return the statistics of the join cache of this process
+JoinCacheStats getJoinCacheStats();
+
+/** Return the directory in which the joined row hashes are saved.  This
+    is read from the MLDB_JOIN_CACHE_DIR environment variable.  Empty (the
+    default) means that they aren't saved.
+*/
+Utf8String getJoinCacheDirectory();
+
+
 /*****************************************************************************/
 /* JOINED DATASET                                                            */
 /*****************************************************************************/
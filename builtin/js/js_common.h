@@ -142,6 +142,10 @@ struct JsPluginContext {
 
     std::vector<ScriptLogEntry> logs;
 
+    /// If false, mldb.log() output is logged but not kept in logs.  This
+    /// is for long lived contexts whose logs are never returned.
+    bool keepLogs = true;
+
     std::function<Json::Value ()> getStatus;
     RestRequestRouter router;
     RestRequestRouter::OnProcessRequest handleRequest;
@@ -12,8 +12,19 @@
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/sql/expression_value.h"
 #include "mldb/sql/sql_expression.h"
+#include "mldb/core/mldb_engine.h"
+#include "mldb/base/hash.h"
+#include "mldb/arch/format.h"
 
 #include <boost/algorithm/string.hpp>
+#include <fstream>
+#include <sstream>
+#include <mutex>
+#include <map>
+#include <thread>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -22,6 +33,18 @@ namespace MLDB {
 
 struct JsFunctionData;
 
+/** A jseval function compiled in the isolate of one thread. */
+struct JsCompiledFunction {
+    ~JsCompiledFunction()
+    {
+        function.Reset();
+        context.Reset();
+    }
+
+    v8::Persistent<v8::Context> context;
+    v8::Persistent<v8::Function> function;
+};
+
 /** Data for a JS function for each thread. */
 struct JsFunctionThreadData {
     JsFunctionThreadData()
@@ -35,9 +58,7 @@ struct JsFunctionThreadData {
     }
 
     JsIsolate * isolate;
-    v8::Persistent<v8::Context> context;
-    v8::Persistent<v8::Script> script;
-    v8::Persistent<v8::Function> function;
+    std::shared_ptr<JsCompiledFunction> compiled;
     const JsFunctionData * data;
 
     void initialize(const JsFunctionData & data);
@@ -53,8 +74,154 @@ struct JsFunctionData {
     std::string filenameForErrorMessages;
     std::vector<std::string> params;
     std::shared_ptr<JsPluginContext> context;
+    std::string key;            ///< Identifies the source and parameters
+    std::string codeCacheFile;  ///< Where V8's code cache is kept, if anywhere
 };
 
+namespace {
+
+/** The plugin context that jseval functions run under, which is what the
+    mldb object refers to.  It's shared by all of them, as creating one
+    means creating a new isolate.
+*/
+std::shared_ptr<JsPluginContext>
+getJsEvalContext(const Utf8String & name, MldbEngine * engine)
+{
+    static std::mutex mutex;
+    static std::map<MldbEngine *, std::shared_ptr<JsPluginContext> > contexts;
+
+    std::unique_lock<std::mutex> guard(mutex);
+    auto & result = contexts[engine];
+    if (!result) {
+        result.reset(new JsPluginContext(name, engine,
+                                         nullptr /* no plugin context */));
+        result->keepLogs = false;
+    }
+    return result;
+}
+
+/** Compiled functions of this thread's isolate, by engine and key.  This
+    means that a query using jseval doesn't recompile the script on each
+    thread each time that it's bound (which is every time it runs), and
+    that functions with the same source share the compiled code.
+*/
+typedef std::unordered_map<std::string, std::shared_ptr<JsCompiledFunction> >
+CompiledFunctions;
+
+CompiledFunctions & getCompiledFunctionsForMyThread()
+{
+    static __thread CompiledFunctions * result = 0;
+
+    if (!result) {
+        result = new CompiledFunctions();
+    }
+
+    return *result;
+}
+
+/// Past this, the compiled functions of a thread are all dropped
+static constexpr size_t MAX_COMPILED_FUNCTIONS_PER_THREAD = 256;
+
+std::string readCodeCache(const std::string & filename)
+{
+    std::ifstream stream(filename, std::ios::binary);
+    if (!stream)
+        return std::string();
+    std::ostringstream result;
+    result << stream.rdbuf();
+    return result.str();
+}
+
+/** Save V8's code cache for a function, so that after a restart it can be
+    loaded without parsing and compiling it again.  Failing to do so
+    doesn't stop the function from being used.
+*/
+void saveCodeCache(const std::string & filename,
+                   const v8::ScriptCompiler::CachedData & data)
+{
+    // Written to the side and renamed, so that a concurrent reader
+    // never sees part of a file
+    std::string tmpFilename
+        = filename + MLDB::format(".tmp%d.", (int)getpid())
+        + std::to_string(std::hash<std::thread::id>()
+                         (std::this_thread::get_id()));
+
+    std::ofstream stream(tmpFilename, std::ios::binary);
+    stream.write((const char *)data.data, data.length);
+    stream.close();
+
+    if (!stream || ::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        cerr << "couldn't save JS code cache file " << filename << endl;
+        ::unlink(tmpFilename.c_str());
+    }
+}
+
+/** Compile the function, using the code cache on disk if there is one.
+    Returns an empty handle if the script didn't compile.  This must be
+    called inside the context that the function will run in.
+*/
+v8::Local<v8::Function>
+compileJsFunction(v8::Isolate * isolate, const JsFunctionData & data)
+{
+    // This is equivalent to new Function('arg1', ..., 'script'), but being
+    // a script it can go through the code cache.  The parentheses make V8
+    // compile the body eagerly, so that it's included in the cache.
+    std::string wrapped = "(function (";
+    for (unsigned i = 0;  i != data.params.size();  ++i) {
+        if (i != 0)
+            wrapped += ",";
+        wrapped += data.params[i];
+    }
+    wrapped += ") {\n" + data.scriptSource.rawString() + "\n})";
+
+    // The line offset keeps line numbers in errors relative to the script
+    v8::ScriptOrigin origin
+        (v8::String::NewFromUtf8(isolate,
+                                 data.filenameForErrorMessages.c_str()),
+         v8::Integer::New(isolate, -1));
+
+    std::string cached;
+    if (!data.codeCacheFile.empty())
+        cached = readCodeCache(data.codeCacheFile);
+
+    v8::ScriptCompiler::CompileOptions options
+        = v8::ScriptCompiler::kNoCompileOptions;
+    v8::ScriptCompiler::CachedData * cachedData = nullptr;
+    if (!cached.empty()) {
+        // Not owned; the source deletes the object but not the buffer
+        cachedData = new v8::ScriptCompiler::CachedData
+            ((const uint8_t *)cached.data(), cached.size());
+        options = v8::ScriptCompiler::kConsumeCodeCache;
+    }
+    else if (!data.codeCacheFile.empty()) {
+        options = v8::ScriptCompiler::kProduceCodeCache;
+    }
+
+    v8::ScriptCompiler::Source source
+        (v8::String::NewFromUtf8(isolate, wrapped.c_str()), origin, cachedData);
+    v8::Local<v8::Script> script;
+    if (!v8::ScriptCompiler::Compile(isolate->GetCurrentContext(), &source,
+                                     options).ToLocal(&script))
+        return v8::Local<v8::Function>();
+
+    if (options == v8::ScriptCompiler::kProduceCodeCache
+        && source.GetCachedData()) {
+        saveCodeCache(data.codeCacheFile, *source.GetCachedData());
+    }
+    else if (options == v8::ScriptCompiler::kConsumeCodeCache
+             && source.GetCachedData()->rejected) {
+        // Made by another version of V8; the next compile replaces it
+        ::unlink(data.codeCacheFile.c_str());
+    }
+
+    v8::Local<v8::Value> result = script->Run();
+    if (result.IsEmpty() || !result->IsFunction())
+        return v8::Local<v8::Function>();
+    return result.As<v8::Function>();
+}
+
+} // file scope
+
 void
 JsFunctionThreadData::
 initialize(const JsFunctionData & data)
@@ -67,18 +234,28 @@ initialize(const JsFunctionData & data)
     isolate = JsIsolate::getIsolateForMyThread();
     this->data = &data;
 
+    CompiledFunctions & functions = getCompiledFunctionsForMyThread();
+    auto it = functions.find(data.key);
+    if (it != functions.end()) {
+        compiled = it->second;
+        return;
+    }
+
+    auto newCompiled = std::make_shared<JsCompiledFunction>();
+
     //v8::Locker locker(this->isolate->isolate);
     v8::Isolate::Scope isolate(this->isolate->isolate);
 
     HandleScope handle_scope(this->isolate->isolate);
 
     // Create a new context.
-    this->context.Reset(this->isolate->isolate,
-                        Context::New(this->isolate->isolate));
+    newCompiled->context.Reset(this->isolate->isolate,
+                               Context::New(this->isolate->isolate));
 
     // Enter the created context for compiling and
     // running the hello world script. 
-    Context::Scope context_scope(this->context.Get(this->isolate->isolate));
+    Context::Scope context_scope
+        (newCompiled->context.Get(this->isolate->isolate));
 
     // Add the mldb object to the context
     auto mldb = MldbJS::registerMe()->NewInstance();
@@ -86,37 +263,16 @@ initialize(const JsFunctionData & data)
                                                 data.engine));
     mldb->SetInternalField(1, v8::External::New(this->isolate->isolate,
                                                 data.context.get()));
-    this->context.Get(this->isolate->isolate)
+    newCompiled->context.Get(this->isolate->isolate)
         ->Global()
         ->Set(String::NewFromUtf8(this->isolate->isolate,
                                  "mldb"), mldb);
     
-    Utf8String jsFunctionSource = data.scriptSource;
-
-    // Create a string containing the JavaScript source code.
-    Handle<String> source
-        = String::NewFromUtf8(this->isolate->isolate,
-                              jsFunctionSource.rawString().c_str());
-
     TryCatch trycatch;
     //trycatch.SetVerbose(true);
 
-    // This is equivalent to fntocall = new Function('arg1', ..., 'script');
-    auto function
-        = this->context.Get(this->isolate->isolate)
-        ->Global()
-        ->Get(v8::String::NewFromUtf8(this->isolate->isolate, "Function"))
-        .As<v8::Object>();
-    
-    std::vector<v8::Handle<v8::Value> > argv;
-    for (unsigned i = 0;  i != data.params.size();  ++i)
-        argv.push_back(v8::String::NewFromUtf8(this->isolate->isolate,
-                                               data.params[i].c_str()));
-    argv.push_back(source);
-
-    v8::Local<v8::Function> compiled 
-        = function->CallAsConstructor(argv.size(), &argv[0])
-        .As<v8::Function>();
+    v8::Local<v8::Function> compiled
+        = compileJsFunction(this->isolate->isolate, data);
 
     if (compiled.IsEmpty()) {  
         auto rep = convertException(trycatch, "Compiling jseval script");
@@ -127,7 +283,12 @@ initialize(const JsFunctionData & data)
                                   "provenance", data.filenameForErrorMessages);
     }
 
-    this->function.Reset(this->isolate->isolate, compiled);
+    newCompiled->function.Reset(this->isolate->isolate, compiled);
+
+    if (functions.size() >= MAX_COMPILED_FUNCTIONS_PER_THREAD)
+        functions.clear();
+    functions[data.key] = newCompiled;
+    this->compiled = std::move(newCompiled);
 }
 
 ExpressionValue
@@ -146,11 +307,13 @@ run(const std::vector<ExpressionValue> & args,
 
     // Enter the created context for compiling and
     // running the hello world script. 
-    Context::Scope context_scope(this->context.Get(this->isolate->isolate));
+    Context::Scope context_scope
+        (compiled->context.Get(this->isolate->isolate));
 
     Date ts = Date::negativeInfinity();
 
     std::vector<v8::Handle<v8::Value> > argv;
+    argv.reserve(args.size());
     for (unsigned i = 2;  i < args.size();  ++i) {
         if (args[i].isRow()) {
             RowValue row;
@@ -166,8 +329,8 @@ run(const std::vector<ExpressionValue> & args,
     TryCatch trycatch;
     //trycatch.SetVerbose(true);
 
-    auto result = this->function.Get(this->isolate->isolate)
-        ->Call(this->context.Get(this->isolate->isolate)->Global(),
+    auto result = compiled->function.Get(this->isolate->isolate)
+        ->Call(compiled->context.Get(this->isolate->isolate)->Global(),
                argv.size(), &argv[0]);
     
     if (result.IsEmpty()) {  
@@ -235,12 +398,22 @@ BoundFunction bindJsEval(const Utf8String & name,
     runner->engine = context.getMldbEngine();
     runner->scriptSource = scriptSource;
     runner->filenameForErrorMessages = "<<eval>>";
-    runner->context.reset(new JsPluginContext(name, runner->engine,
-                                              nullptr /* no plugin context */));
+    runner->context = getJsEvalContext(name, runner->engine);
                           
     string params = args[1].constantValue().toString();
     boost::split(runner->params, params,
                  boost::is_any_of(","));
+
+    // The code cache is kept with the engine's other caches, by a hash of
+    // what's compiled
+    string hash = md5HashToHex(params + "\n" + scriptSource.rawString());
+    runner->key = MLDB::format("%p:", (void *)runner->engine) + hash;
+    string cacheDir = runner->engine->getCacheDirectory();
+    if (!cacheDir.empty()) {
+        string codeCacheDir = cacheDir + "/js-code-cache";
+        ::mkdir(codeCacheDir.c_str(), 0777);
+        runner->codeCacheFile = codeCacheDir + "/" + hash + ".v8cache";
+    }
     
     // 3.  We don't know what it returns; TODO: allow it to be specified
     auto info = std::make_shared<AnyValueInfo>();
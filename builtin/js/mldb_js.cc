@@ -1016,7 +1016,9 @@ struct MldbJS::Methods {
             {
                 std::unique_lock<std::mutex> guard(context->logMutex);
                 LOG(mldbJsCategory) << line;
-                context->logs.emplace_back(Date::now(), "log", Utf8String(line));
+                if (context->keepLogs)
+                    context->logs.emplace_back(Date::now(), "log",
+                                               Utf8String(line));
             }
 
             args.GetReturnValue().Set(args.This());
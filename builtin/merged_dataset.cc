@@ -8,6 +8,7 @@
 #include "mldb/sql/sql_expression.h"
 #include "id_hash.h"
 #include "merge_hash_entries.h"
+#include "mldb/arch/bitops.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/vector_description.h"
@@ -62,6 +63,10 @@ struct MergedDataset::Itl
     /// Matrix view.  Length is the same as that of datasets.
     std::vector<std::shared_ptr<MatrixView> > matrices;
 
+    /// Is each row in only one of the datasets?  In that case the merged
+    /// dataset is a concatenation of the rows of the datasets.
+    bool disjointRows = true;
+
     shared_ptr<spdlog::logger> logger;
 
     Itl(MldbEngine * engine, std::vector<std::shared_ptr<Dataset> > datasets)
@@ -185,6 +190,14 @@ struct MergedDataset::Itl
         mergeColumns.join();
         mergeRows.join();
 
+        auto onRow = [&] (uint64_t hash, uint32_t bitmap)
+            {
+                disjointRows = (bitmap & (bitmap - 1)) == 0;
+                return disjointRows;
+            };
+
+        rowIndex.forEach(onRow);
+
         this->datasetsIn = std::move(datasets);
         this->datasets = std::move(toMerge);
         for (auto & d: this->datasets) {
@@ -210,11 +223,51 @@ struct MergedDataset::Itl
         /* set where the stream should start*/
         virtual void initAt(size_t start) override
         {
-            it = source->rowIndex.begin();
+            // Skip over whole buckets before walking within one
+            size_t bucket = 0;
+            while (bucket + 1 < IdHashes::NBUCKETS
+                   && start >= source->rowIndex.buckets[bucket].size()) {
+                start -= source->rowIndex.buckets[bucket].size();
+                ++bucket;
+            }
+            it = IdHashes::const_iterator(&source->rowIndex, bucket);
             for (size_t i = 0; i < start; ++i)
                 ++it;
         }
 
+        /// Parallelize bucket by bucket of the row index, which allows
+        /// for natural boundaries.
+        virtual std::vector<std::shared_ptr<RowStream> >
+        parallelize(int64_t rowStreamTotalRows,
+                    ssize_t approxNumberOfChildStreams,
+                    std::vector<size_t> * streamOffsets) const override
+        {
+            std::vector<std::shared_ptr<RowStream> > streams;
+            if (streamOffsets)
+                streamOffsets->clear();
+
+            size_t startAt = 0;
+            for (size_t i = 0;  i < IdHashes::NBUCKETS;  ++i) {
+                size_t numRows = source->rowIndex.buckets[i].size();
+                if (numRows == 0)
+                    continue;
+                if (streamOffsets)
+                    streamOffsets->push_back(startAt);
+                startAt += numRows;
+
+                auto stream = std::make_shared<MergedRowStream>(source);
+                stream->it = IdHashes::const_iterator(&source->rowIndex, i);
+                streams.emplace_back(std::move(stream));
+            }
+
+            if (streamOffsets)
+                streamOffsets->push_back(startAt);
+
+            ExcAssertEqual(startAt, rowStreamTotalRows);
+
+            return streams;
+        }
+
         virtual RowPath next() override
         {
             uint64_t hash = (*it).first;
@@ -711,6 +764,24 @@ getRowStream() const
     return make_shared<MergedDataset::Itl::MergedRowStream>(itl.get());
 }
 
+GenerateRowsWhereFunction
+MergedDataset::
+generateRowsWhere(const SqlBindingScope & context,
+                  const Utf8String& alias,
+                  const SqlExpression & where,
+                  ssize_t offset,
+                  ssize_t limit) const
+{
+    // If a row can take its columns from several datasets, the where
+    // expression needs all of them and can't be pushed down.  A constant
+    // where is a scan of the merged row stream.
+    if (!itl->disjointRows || where.isConstant())
+        return Dataset::generateRowsWhere(context, alias, where, offset, limit);
+
+    return generateChildRowsWhere(itl->datasets, context, alias, where,
+                                  false /* prefixChildIndex */);
+}
+
 static RegisterDatasetType<MergedDataset, MergedDatasetConfig> 
 regMerged(builtinPackage(),
           "merged",
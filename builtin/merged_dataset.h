@@ -59,6 +59,17 @@ struct MergedDataset: public Dataset {
 
     virtual std::pair<Date, Date> getTimestampRange() const;
 
+    /** Push the where expression down into each of the datasets, so that
+        they can use their own indexes, when no row is in more than one of
+        them.
+    */
+    virtual GenerateRowsWhereFunction
+    generateRowsWhere(const SqlBindingScope & context,
+                      const Utf8String& alias,
+                      const SqlExpression & where,
+                      ssize_t offset,
+                      ssize_t limit) const;
+
 private:
     MergedDatasetConfig datasetConfig;
     struct Itl;
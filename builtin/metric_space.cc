@@ -14,6 +14,10 @@
 #include "mldb/types/annotated_exception.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/arch/simd_vector.h"
+#include "mldb/base/parallel.h"
+#include "mldb/types/db/persistent.h"
+#include <random>
+#include <numeric>
 
 using namespace std;
 
@@ -35,6 +39,167 @@ MetricSpaceDescription()
 }
 
 
+/*****************************************************************************/
+/* PRODUCT QUANTIZER                                                         */
+/*****************************************************************************/
+
+namespace {
+
+int closestCentroid(const float * centroids, const float * vec, int width)
+{
+    int result = 0;
+    double bestDist = INFINITY;
+    for (int c = 0;  c < ProductQuantizer::NUM_CENTROIDS;  ++c) {
+        double dist = SIMD::vec_euclid(centroids + c * width, vec, width);
+        if (dist < bestDist) {
+            bestDist = dist;
+            result = c;
+        }
+    }
+    return result;
+}
+
+} // file scope
+
+void
+ProductQuantizer::
+train(const std::vector<const float *> & sample,
+      int numDims, int numSubspaces, int numIterations)
+{
+    ExcAssert(!sample.empty());
+
+    if (numSubspaces < 1 || numSubspaces > numDims)
+        throw AnnotatedException
+            (400, "The number of product quantization subspaces must be "
+             "between 1 and the number of dimensions (" + to_string(numDims)
+             + "); got " + to_string(numSubspaces));
+
+    this->numDims = numDims;
+    this->numSubspaces = numSubspaces;
+    subspaceStart.resize(numSubspaces + 1);
+    for (int j = 0;  j <= numSubspaces;  ++j)
+        subspaceStart[j] = (int64_t)j * numDims / numSubspaces;
+    centroids.resize(numDims * NUM_CENTROIDS);
+
+    size_t n = sample.size();
+
+    // Each subspace is an independent k-means problem
+    auto trainSubspace = [&] (int j)
+        {
+            int start = subspaceStart[j];
+            int width = subspaceWidth(j);
+            float * subspaceCentroids = &centroids[start * NUM_CENTROIDS];
+
+            // Start from a random choice of vectors from the sample; if
+            // there are fewer than NUM_CENTROIDS, some are repeated
+            std::mt19937 rng(j + 1);
+            std::vector<int> order(n);
+            std::iota(order.begin(), order.end(), 0);
+            std::shuffle(order.begin(), order.end(), rng);
+
+            for (int c = 0;  c < NUM_CENTROIDS;  ++c) {
+                const float * vec = sample[order[c % n]] + start;
+                std::copy(vec, vec + width, subspaceCentroids + c * width);
+            }
+
+            std::vector<double> sums(NUM_CENTROIDS * width);
+            std::vector<int> counts(NUM_CENTROIDS);
+
+            for (int iter = 0;  iter < numIterations;  ++iter) {
+                std::fill(sums.begin(), sums.end(), 0.0);
+                std::fill(counts.begin(), counts.end(), 0);
+
+                for (size_t i = 0;  i < n;  ++i) {
+                    const float * vec = sample[i] + start;
+                    int c = closestCentroid(subspaceCentroids, vec, width);
+                    counts[c] += 1;
+                    for (int k = 0;  k < width;  ++k)
+                        sums[c * width + k] += vec[k];
+                }
+
+                // Empty clusters keep their centroid
+                for (int c = 0;  c < NUM_CENTROIDS;  ++c) {
+                    if (counts[c] == 0)
+                        continue;
+                    for (int k = 0;  k < width;  ++k) {
+                        subspaceCentroids[c * width + k]
+                            = sums[c * width + k] / counts[c];
+                    }
+                }
+            }
+        };
+
+    parallelMap(0, numSubspaces, trainSubspace);
+}
+
+void
+ProductQuantizer::
+encode(const float * vec, uint8_t * codes) const
+{
+    for (int j = 0;  j < numSubspaces;  ++j) {
+        codes[j] = closestCentroid(centroid(j, 0), vec + subspaceStart[j],
+                                   subspaceWidth(j));
+    }
+}
+
+void
+ProductQuantizer::
+decode(const uint8_t * codes, float * vec) const
+{
+    for (int j = 0;  j < numSubspaces;  ++j) {
+        const float * c = centroid(j, codes[j]);
+        std::copy(c, c + subspaceWidth(j), vec + subspaceStart[j]);
+    }
+}
+
+void
+ProductQuantizer::
+serialize(DB::Store_Writer & store) const
+{
+    store << DB::compact_size_t(numDims) << DB::compact_size_t(numSubspaces)
+          << centroids;
+}
+
+void
+ProductQuantizer::
+reconstitute(DB::Store_Reader & store)
+{
+    DB::compact_size_t dims(store), subspaces(store);
+    numDims = dims;
+    numSubspaces = subspaces;
+    store >> centroids;
+    ExcAssertEqual(centroids.size(), (size_t)numDims * NUM_CENTROIDS);
+    subspaceStart.resize(numSubspaces + 1);
+    for (int j = 0;  j <= numSubspaces;  ++j)
+        subspaceStart[j] = (int64_t)j * numDims / numSubspaces;
+}
+
+
+/*****************************************************************************/
+/* ADC TABLE                                                                 */
+/*****************************************************************************/
+
+float
+AdcTable::
+sum(const uint8_t * codes) const
+{
+    // Four independent accumulators, to allow the lookups to overlap
+    size_t numSubspaces = entries.size() / ProductQuantizer::NUM_CENTROIDS;
+    const float * e = entries.data();
+    float total[4] = { 0, 0, 0, 0 };
+    size_t j = 0;
+    for (;  j + 4 <= numSubspaces;  j += 4) {
+        for (int k = 0;  k < 4;  ++k) {
+            total[k] += e[(j + k) * ProductQuantizer::NUM_CENTROIDS
+                          + codes[j + k]];
+        }
+    }
+    for (;  j < numSubspaces;  ++j)
+        total[0] += e[j * ProductQuantizer::NUM_CENTROIDS + codes[j]];
+    return (total[0] + total[1]) + (total[2] + total[3]);
+}
+
+
 /*****************************************************************************/
 /* DISTANCE METRIC                                                           */
 /*****************************************************************************/
@@ -129,6 +294,60 @@ dist(int rowNum1, int rowNum2,
     return sqrtf(distSquared);
 }
 
+void
+EuclideanDistanceMetric::
+dists(const float * const * queries, size_t numQueries,
+      const int * rowNums, const float * const * rows,
+      size_t numRows, size_t numDims, float * dists) const
+{
+    if (numQueries == 1) {
+        // Direct differences avoid the cancellation in the expansion below
+        SIMD::vec_euclid_many(queries[0], rows, dists, numRows, numDims);
+        for (size_t j = 0;  j < numRows;  ++j)
+            dists[j] = sqrtf(dists[j]);
+        return;
+    }
+
+    // ||x - y||^2 = ||x||^2 + ||y||^2 - 2 x . y, as in dist(), with all of
+    // the dot products calculated at once
+    SIMD::mat_dotprod(queries, numQueries, rows, numRows, dists, numDims);
+
+    for (size_t i = 0;  i < numQueries;  ++i) {
+        double querySumDist = SIMD::vec_twonorm_sqr_dp(queries[i], numDims);
+        float * queryDists = dists + i * numRows;
+        for (size_t j = 0;  j < numRows;  ++j) {
+            float distSquared = querySumDist + sum_dist.at(rowNums[j])
+                - 2.0f * queryDists[j];
+            queryDists[j] = sqrtf(std::max(distSquared, 0.0f));
+        }
+    }
+}
+
+void
+EuclideanDistanceMetric::
+adcTable(const ProductQuantizer & pq,
+         const distribution<float> & query,
+         AdcTable & table) const
+{
+    ExcAssertEqual(query.size(), pq.numDims);
+    table.entries.resize(pq.numSubspaces * ProductQuantizer::NUM_CENTROIDS);
+
+    for (int j = 0;  j < pq.numSubspaces;  ++j) {
+        const float * q = query.data() + pq.subspaceStart[j];
+        for (int c = 0;  c < ProductQuantizer::NUM_CENTROIDS;  ++c) {
+            table.entries[j * ProductQuantizer::NUM_CENTROIDS + c]
+                = SIMD::vec_euclid(q, pq.centroid(j, c), pq.subspaceWidth(j));
+        }
+    }
+}
+
+float
+EuclideanDistanceMetric::
+adcDist(int rowNum, const AdcTable & table, const uint8_t * codes) const
+{
+    return sqrtf(std::max(table.sum(codes), 0.0f));
+}
+
 
 /*****************************************************************************/
 /* COSINE DISTANCE METRIC                                                    */
@@ -237,6 +456,70 @@ dist(int rowNum1, int rowNum2,
     return result;
 }
 
+void
+CosineDistanceMetric::
+dists(const float * const * queries, size_t numQueries,
+      const int * rowNums, const float * const * rows,
+      size_t numRows, size_t numDims, float * dists) const
+{
+    SIMD::mat_dotprod(queries, numQueries, rows, numRows, dists, numDims);
+
+    for (size_t i = 0;  i < numQueries;  ++i) {
+        // Same conventions as dist() for zero vectors
+        double twonorm = sqrt(SIMD::vec_twonorm_sqr_dp(queries[i], numDims));
+        float queryRecip = twonorm == 0.0 ? INFINITY : 1.0 / twonorm;
+        float * queryDists = dists + i * numRows;
+
+        for (size_t j = 0;  j < numRows;  ++j) {
+            float rowRecip = two_norm_recip.at(rowNums[j]);
+            if (!isfinite(queryRecip) || !isfinite(rowRecip)) {
+                queryDists[j]
+                    = !isfinite(queryRecip) && !isfinite(rowRecip) ? 0.0 : 1.0;
+                continue;
+            }
+            queryDists[j] = std::max(1.0f - queryDists[j] * queryRecip
+                                     * rowRecip, 0.0f);
+        }
+    }
+}
+
+void
+CosineDistanceMetric::
+adcTable(const ProductQuantizer & pq,
+         const distribution<float> & query,
+         AdcTable & table) const
+{
+    ExcAssertEqual(query.size(), pq.numDims);
+    table.entries.resize(pq.numSubspaces * ProductQuantizer::NUM_CENTROIDS);
+
+    for (int j = 0;  j < pq.numSubspaces;  ++j) {
+        const float * q = query.data() + pq.subspaceStart[j];
+        for (int c = 0;  c < ProductQuantizer::NUM_CENTROIDS;  ++c) {
+            table.entries[j * ProductQuantizer::NUM_CENTROIDS + c]
+                = SIMD::vec_dotprod_dp(q, pq.centroid(j, c),
+                                       pq.subspaceWidth(j));
+        }
+    }
+
+    // Same conventions as addRow for zero vectors
+    float twonorm = query.two_norm();
+    table.queryScale = twonorm == 0.0 ? INFINITY : 1.0 / twonorm;
+}
+
+float
+CosineDistanceMetric::
+adcDist(int rowNum, const AdcTable & table, const uint8_t * codes) const
+{
+    float rowScale = two_norm_recip.at(rowNum);
+    if (!isfinite(table.queryScale) && !isfinite(rowScale))
+        return 0.0;
+    if (!isfinite(table.queryScale) || !isfinite(rowScale))
+        return 1.0;
+
+    return std::max(1.0f - table.sum(codes) * table.queryScale * rowScale,
+                    0.0f);
+}
+
 
 
 } // namespace MLDB
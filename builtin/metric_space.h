@@ -10,7 +10,9 @@
 #pragma once
 
 #include "mldb/types/value_description_fwd.h"
+#include "mldb/types/db/persistent_fwd.h"
 #include "mldb/utils/distribution.h"
+#include <cstdint>
 
 
 namespace MLDB {
@@ -24,6 +26,79 @@ enum MetricSpace {
 DECLARE_ENUM_DESCRIPTION(MetricSpace);
 
 
+/*****************************************************************************/
+/* PRODUCT QUANTIZER                                                         */
+/*****************************************************************************/
+
+/** Product quantizer, which splits vectors into numSubspaces contiguous
+    subvectors and encodes each of them as the number of the closest of
+    NUM_CENTROIDS centroids for that subspace.  A vector is then stored in
+    numSubspaces bytes, and its distance to a query can be calculated from
+    numSubspaces lookups in a table made for the query (asymmetric distance
+    computation).
+*/
+struct ProductQuantizer {
+    static constexpr int NUM_CENTROIDS = 256;
+
+    /** Train the codebooks with k-means over the given sample of vectors,
+        each of which has numDims coordinates.
+    */
+    void train(const std::vector<const float *> & sample,
+               int numDims, int numSubspaces, int numIterations = 10);
+
+    bool trained() const
+    {
+        return !centroids.empty();
+    }
+
+    /** Write the numSubspaces codes of the closest centroids to vec. */
+    void encode(const float * vec, uint8_t * codes) const;
+
+    /** Write the numDims coordinates represented by codes to vec. */
+    void decode(const uint8_t * codes, float * vec) const;
+
+    /** Centroid number c of subspace j, which has subspaceWidth(j)
+        coordinates.
+    */
+    const float * centroid(int j, int c) const
+    {
+        return &centroids[subspaceStart[j] * NUM_CENTROIDS
+                          + c * subspaceWidth(j)];
+    }
+
+    int subspaceWidth(int j) const
+    {
+        return subspaceStart[j + 1] - subspaceStart[j];
+    }
+
+    int numDims = 0;
+    int numSubspaces = 0;
+    std::vector<int> subspaceStart;  ///< First dimension of each subspace
+    std::vector<float> centroids;    ///< All centroids of each subspace
+
+    void serialize(DB::Store_Writer & store) const;
+    void reconstitute(DB::Store_Reader & store);
+};
+
+
+/*****************************************************************************/
+/* ADC TABLE                                                                 */
+/*****************************************************************************/
+
+/** Lookup table for the asymmetric distance computation between a query
+    and vectors encoded by a ProductQuantizer.  Each metric decides what
+    the entries and the query scale mean.
+*/
+struct AdcTable {
+    /// Entry for centroid c of subspace j is at j * NUM_CENTROIDS + c
+    std::vector<float> entries;
+    float queryScale = 0.0;
+
+    /** Sum of the entries for the given codes. */
+    float sum(const uint8_t * codes) const;
+};
+
+
 /*****************************************************************************/
 /* DISTANCE METRIC                                                           */
 /*****************************************************************************/
@@ -44,6 +119,29 @@ struct DistanceMetric {
                        const distribution<float> & coords1,
                        const distribution<float> & coords2) const = 0;
 
+    /** Calculate the distances from each of the numQueries queries, which
+        are not rows, to each of the numRows rows whose numbers and
+        coordinates are passed, into dists[query * numRows + row].  All
+        of them have numDims coordinates.  This uses the batched SIMD
+        kernels, and so is much faster than calling dist() for each pair,
+        but the results may differ from it by rounding.
+    */
+    virtual void dists(const float * const * queries, size_t numQueries,
+                       const int * rowNums, const float * const * rows,
+                       size_t numRows, size_t numDims,
+                       float * dists) const = 0;
+
+    /** Fill in the table used by adcDist for the given query. */
+    virtual void adcTable(const ProductQuantizer & pq,
+                          const distribution<float> & query,
+                          AdcTable & table) const = 0;
+
+    /** Approximate distance between the query that the table was made for
+        and the given row, whose product quantization codes are passed.
+    */
+    virtual float adcDist(int rowNum, const AdcTable & table,
+                          const uint8_t * codes) const = 0;
+
     /** Factor for distance metric objects. */
     static DistanceMetric * create(MetricSpace space);
 };
@@ -61,6 +159,18 @@ struct EuclideanDistanceMetric: public DistanceMetric {
                const distribution<float> & coords1,
                const distribution<float> & coords2) const;
 
+    void dists(const float * const * queries, size_t numQueries,
+               const int * rowNums, const float * const * rows,
+               size_t numRows, size_t numDims, float * dists) const;
+
+    /// Entries are squared distances from the query's subvectors
+    void adcTable(const ProductQuantizer & pq,
+                  const distribution<float> & query,
+                  AdcTable & table) const;
+
+    float adcDist(int rowNum, const AdcTable & table,
+                  const uint8_t * codes) const;
+
     /// Pre cached ||vec||^2 for each row, to allow optimization of the
     /// calculation.
     std::vector<double> sum_dist;
@@ -83,6 +193,19 @@ struct CosineDistanceMetric: public DistanceMetric {
                const distribution<float> & coords1,
                const distribution<float> & coords2) const;
 
+    void dists(const float * const * queries, size_t numQueries,
+               const int * rowNums, const float * const * rows,
+               size_t numRows, size_t numDims, float * dists) const;
+
+    /// Entries are dot products with the query's subvectors, and the query
+    /// scale is the reciprocal of its two norm
+    void adcTable(const ProductQuantizer & pq,
+                  const distribution<float> & query,
+                  AdcTable & table) const;
+
+    float adcDist(int rowNum, const AdcTable & table,
+                  const uint8_t * codes) const;
+
     /// Pre-cached reciprocal of the two norm of each vector, to allow
     /// optimization of the calculation.
     std::vector<double> two_norm_recip;
@@ -14,6 +14,11 @@
 #include "mldb/utils/string_functions.h"
 #include "mldb/utils/profile.h"
 #include "mldb/utils/distribution.h"
+#include "mldb/arch/simd_vector.h"
+#include "mldb/base/parallel.h"
+#include <unordered_map>
+#include <atomic>
+#include <cmath>
 
 using namespace std;
 
@@ -59,6 +64,104 @@ PoolingOutputDescription::PoolingOutputDescription()
              "Embedding corresponding to the input words.");
 }
 
+/** The embedding dataset as a contiguous matrix with one row per word, so
+    that pooling is a matter of looking up the rows of the words in a hash
+    table and running vector kernels over them.
+*/
+struct PoolingEmbedding {
+    enum Aggregator { AVG, MIN, MAX, SUM };
+
+    std::vector<Aggregator> aggregators;       ///< In order of output
+    size_t numColumns = 0;
+    std::vector<float> values;                 ///< numColumns per row
+    std::vector<Date> timestamps;              ///< Latest value of each row
+    std::unordered_map<Utf8String, uint32_t> rowIndex; ///< rowName() -> row
+    bool hasMissing = false;                   ///< Are there any null values?
+
+    const float * row(uint32_t i) const
+    {
+        return values.data() + (size_t)i * numColumns;
+    }
+
+    /** Pool the given rows, which must be distinct, and append the result
+        for each of the aggregators to output.  Null values are skipped by
+        all the aggregators, as they are in SQL.
+    */
+    void pool(const std::vector<uint32_t> & rows,
+              std::vector<double> & output) const;
+};
+
+void
+PoolingEmbedding::
+pool(const std::vector<uint32_t> & rows,
+     std::vector<double> & output) const
+{
+    size_t n = numColumns;
+    bool needSum = false, needMin = false, needMax = false;
+    for (auto agg: aggregators) {
+        needSum = needSum || agg == AVG || agg == SUM;
+        needMin = needMin || agg == MIN;
+        needMax = needMax || agg == MAX;
+    }
+
+    std::vector<double> sum(needSum ? n : 0, 0.0);
+    std::vector<float> mins, maxes;
+    std::vector<uint32_t> counts;
+
+    if (!hasMissing) {
+        // Every value is present, so it's a matter of vector operations
+        // over whole rows
+        if (needMin)
+            mins.assign(row(rows[0]), row(rows[0]) + n);
+        if (needMax)
+            maxes.assign(row(rows[0]), row(rows[0]) + n);
+        for (size_t i = 0;  i < rows.size();  ++i) {
+            const float * r = row(rows[i]);
+            if (needSum)
+                SIMD::vec_add(sum.data(), r, sum.data(), n);
+            if (i == 0)
+                continue;
+            if (needMin)
+                SIMD::vec_min(mins.data(), r, mins.data(), n);
+            if (needMax)
+                SIMD::vec_max(maxes.data(), r, maxes.data(), n);
+        }
+        counts.assign(n, rows.size());
+    }
+    else {
+        mins.assign(n, INFINITY);
+        maxes.assign(n, -INFINITY);
+        sum.assign(n, 0.0);
+        counts.assign(n, 0);
+        for (uint32_t i: rows) {
+            const float * r = row(i);
+            for (size_t j = 0;  j < n;  ++j) {
+                if (std::isnan(r[j]))
+                    continue;
+                sum[j] += r[j];
+                mins[j] = std::min(mins[j], r[j]);
+                maxes[j] = std::max(maxes[j], r[j]);
+                counts[j] += 1;
+            }
+        }
+    }
+
+    for (auto agg: aggregators) {
+        for (size_t j = 0;  j < n;  ++j) {
+            if (counts[j] == 0) {
+                output.push_back(std::numeric_limits<float>::quiet_NaN());
+                continue;
+            }
+            switch (agg) {
+            case AVG:  output.push_back(sum[j] / counts[j]);  break;
+            case SUM:  output.push_back(sum[j]);  break;
+            case MIN:  output.push_back(mins[j]);  break;
+            case MAX:  output.push_back(maxes[j]);  break;
+            }
+        }
+    }
+}
+
 PoolingFunction::
 PoolingFunction(MldbEngine * owner,
                PolyConfig config,
@@ -67,109 +170,142 @@ PoolingFunction(MldbEngine * owner,
 {
     functionConfig = config.params.convert<PoolingFunctionConfig>();
 
-    SqlQueryFunctionConfig fnConfig;
-    fnConfig.query.stm.reset(new SelectStatement());
-
     set<Utf8String> validAggs = {"avg", "min", "max", "sum"};
     if(functionConfig.aggregators.size() == 0) {
         functionConfig.aggregators.push_back("avg");
     }
 
-    // Build SELECT statement and parse it
-    string select_expr;
+    auto result = std::make_shared<PoolingEmbedding>();
+
     for(auto agg : functionConfig.aggregators) {
         if(validAggs.find(agg) == validAggs.end())
             throw MLDB::Exception("Unknown aggregator: " + agg.rawString());
 
-        if(select_expr.size() > 0)
-            select_expr += ",";
-
-        select_expr += MLDB::format("%s({*}) as %s", agg.rawData(), agg.rawData());
+        if (agg == "avg")
+            result->aggregators.push_back(PoolingEmbedding::AVG);
+        else if (agg == "min")
+            result->aggregators.push_back(PoolingEmbedding::MIN);
+        else if (agg == "max")
+            result->aggregators.push_back(PoolingEmbedding::MAX);
+        else result->aggregators.push_back(PoolingEmbedding::SUM);
     }
-    fnConfig.query.stm->select = SelectExpression::parseList(select_expr);
-    fnConfig.query.stm->from = functionConfig.embeddingDataset;
-    fnConfig.query.stm->where = SqlExpression::parse("rowName() IN (KEYS OF $words)");
-
-    PolyConfig fnPConfig;
-    fnPConfig.params = fnConfig;
-
-    queryFunction = std::make_shared<SqlQueryFunction>(owner, fnPConfig,
-                                                       onProgress);
 
     SqlExpressionMldbScope context(owner);
     ConvertProgressToJson convertProgressToJson(onProgress);
     boundEmbeddingDataset = functionConfig.embeddingDataset->bind(context, convertProgressToJson);
     
     columnNames = boundEmbeddingDataset.dataset->getRowInfo()->allColumnNames();
-}
 
-struct PoolingFunctionApplier: public FunctionApplierT<PoolingInput, PoolingOutput> {
-    PoolingFunctionApplier(const PoolingFunction * owner,
-                           SqlBindingScope & outerContext,
-                           const std::vector<std::shared_ptr<ExpressionValueInfo> > & input)
-        : FunctionApplierT<PoolingInput, PoolingOutput>(owner)
-    {
-        queryApplier = owner->queryFunction->bind(outerContext, input);
-    }
+    // Read the whole embedding into memory.  The rows are read in
+    // parallel, as datasets can be read from many threads at once.
+    const Dataset & dataset = *boundEmbeddingDataset.dataset;
+    std::vector<RowPath> rowPaths = dataset.getMatrixView()->getRowPaths();
+
+    result->numColumns = columnNames.size();
+    result->values.resize(rowPaths.size() * columnNames.size());
+    result->timestamps.resize(rowPaths.size());
+
+    std::atomic<bool> hasMissing(false);
+
+    auto onRows = [&] (size_t begin, size_t end)
+        {
+            for (size_t i = begin;  i < end;  ++i) {
+                ExpressionValue row = dataset.getRowExpr(rowPaths[i]);
+                distribution<double> values
+                    = row.getEmbedding(columnNames.data(), columnNames.size());
+                float * out = result->values.data() + i * columnNames.size();
+                for (size_t j = 0;  j < values.size();  ++j) {
+                    out[j] = values[j];
+                    if (std::isnan(out[j]))
+                        hasMissing = true;
+                }
+                result->timestamps[i] = row.getEffectiveTimestamp();
+            }
+        };
 
-    std::unique_ptr<FunctionApplier> queryApplier;
-};
+    parallelMapChunked(0, rowPaths.size(), 1024 /* chunk size */, onRows);
+
+    result->hasMissing = hasMissing;
+
+    // Words are matched to rows as rowName() IN (KEYS OF words) would
+    result->rowIndex.reserve(rowPaths.size());
+    for (size_t i = 0;  i < rowPaths.size();  ++i)
+        result->rowIndex.emplace(rowPaths[i].toUtf8String(), i);
+
+    embedding = std::move(result);
+}
 
 PoolingOutput 
 PoolingFunction::
-applyT(const ApplierT & applier_, PoolingInput input) const
+applyT(const ApplierT & applier, PoolingInput input) const
 {
     //   STACK_PROFILE(PoolingFunction_apply)
 
-    auto & applier = static_cast<const PoolingFunctionApplier &>(applier_);
-
     size_t num_embed_cols = columnNames.size() * functionConfig.aggregators.size();
 
     Date outputTs = input.words.getEffectiveTimestamp();
-    StructValue inputRow;
-    inputRow.emplace_back("words", std::move(input.words));
 
-    ExpressionValue queryOutput
-        = queryFunction->apply(*applier.queryApplier, std::move(inputRow));
+    std::vector<uint32_t> rows;
+    if (input.words.isRow()) {
+        auto onColumn = [&] (const PathElement & word,
+                             const ExpressionValue & val)
+            {
+                auto it = embedding->rowIndex.find(word.toUtf8String());
+                if (it != embedding->rowIndex.end())
+                    rows.push_back(it->second);
+                return true;
+            };
+        input.words.forEachColumn(onColumn);
+
+        // Each row of the embedding is only pooled once
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    }
 
     std::vector<double> outputEmbedding;
     outputEmbedding.reserve(num_embed_cols);
 
-    if (queryOutput.empty()) {
+    if (rows.empty()) {
         outputEmbedding.resize(num_embed_cols, 0.0);  // TODO: should be NaN?
     }
     else {
-        for (auto & agg: functionConfig.aggregators) {
-
-            ExpressionValue val = queryOutput.getColumn(agg);
-
-            if (val.empty()) {
-                throw AnnotatedException(500, "Didn't find output of aggregator",
-                                          "queryOutput", queryOutput,
-                                          "aggregator", agg);
-            }
+        embedding->pool(rows, outputEmbedding);
 
-            distribution<double> dist
-                = val.getEmbedding(columnNames.data(), columnNames.size());
-            outputEmbedding.insert(outputEmbedding.end(),
-                                   dist.begin(), dist.end());
+        for (uint32_t row: rows)
+            outputTs.setMax(embedding->timestamps[row]);
 
-            outputTs.setMax(val.getEffectiveTimestamp());
-        }
-        
         ExcAssertEqual(outputEmbedding.size(), num_embed_cols);
     }   
 
     return {ExpressionValue(std::move(outputEmbedding), outputTs)};
 }
+
+std::vector<ExpressionValue>
+PoolingFunction::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    std::vector<ExpressionValue> result(inputs.size());
+    const Function & function = *this;
+
+    auto doChunk = [&] (size_t begin, size_t end)
+        {
+            for (size_t i = begin;  i < end;  ++i)
+                result[i] = function.apply(applier, inputs[i]);
+        };
+
+    parallelMapChunked(0, inputs.size(), 64 /* chunk size */, doChunk);
+
+    return result;
+}
     
 std::unique_ptr<FunctionApplierT<PoolingInput, PoolingOutput> >
 PoolingFunction::
 bindT(SqlBindingScope & outerContext,
       const std::vector<std::shared_ptr<ExpressionValueInfo> > & input) const
 {
-    std::unique_ptr<PoolingFunctionApplier> result
-        (new PoolingFunctionApplier(this, outerContext, input));
+    std::unique_ptr<FunctionApplierT<PoolingInput, PoolingOutput> > result
+        (new FunctionApplierT<PoolingInput, PoolingOutput>(this));
     result->info = getFunctionInfo();
 
     // Check that all values on the passed input are compatible with the required
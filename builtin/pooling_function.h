@@ -11,7 +11,6 @@
 #include "mldb/core/value_function.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/types/optional.h"
-#include "mldb/builtin/sql_functions.h"
 
 
 namespace MLDB {
@@ -50,6 +49,8 @@ struct PoolingOutput {
 
 DECLARE_STRUCTURE_DESCRIPTION(PoolingOutput);
 
+struct PoolingEmbedding;
+
 struct PoolingFunction: public ValueFunctionT<PoolingInput, PoolingOutput> {
     PoolingFunction(MldbEngine * owner,
                    PolyConfig config,
@@ -62,15 +63,18 @@ struct PoolingFunction: public ValueFunctionT<PoolingInput, PoolingOutput> {
     bindT(SqlBindingScope & outerContext,
           const std::vector<std::shared_ptr<ExpressionValueInfo> > & input)
         const override;
-   
-    std::shared_ptr<SqlQueryFunction> queryFunction;
+
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const override;
 
     BoundTableExpression boundEmbeddingDataset;
 
     PoolingFunctionConfig functionConfig;
     std::vector<ColumnPath> columnNames;
 
-    SelectExpression select;
+    /// The embedding dataset, read into memory when the function is created
+    std::shared_ptr<const PoolingEmbedding> embedding;
 };
 
 } // namespace MLDB
@@ -20,6 +20,7 @@ PYTHON_PLUGIN_SOURCES := \
 	python_plugin_context.cc \
 	python_entities.cc \
 	python_converters.cc \
+	python_buffer.cc \
 
 
 PYTHON_PLUGIN_LINK := \
@@ -155,6 +155,12 @@ class mldb_wrapper(object):
         def get_http_bound_address(self):
             return self._mldb.get_http_bound_address()
 
+        def query_array(self, query):
+            """Run the query and return (row names, column names, array),
+            where the array holds the values as doubles and can be used by
+            numpy without copying, eg numpy.asarray(array)."""
+            return self._mldb.query_array(query)
+
         def get(self, url, data=None, **kwargs):
             query_string = []
             for k, v in list(kwargs.items()):
@@ -0,0 +1,251 @@
+/** python_buffer.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Exchange of arrays with Python through the buffer protocol.
+*/
+
+#include "python_buffer.h"
+#include "python_interpreter.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/base/exc_assert.h"
+#include <cstring>
+#include <string>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace Python {
+
+namespace {
+
+
+/*****************************************************************************/
+/* ARRAY OBJECT                                                              */
+/*****************************************************************************/
+
+/** What a Python array object exposes.  It's kept out of the object itself
+    so that it can be an ordinary C++ object.
+*/
+struct ArrayState {
+    std::shared_ptr<const void> owner;
+    const void * data;
+    std::string format;
+    Py_ssize_t itemSize;
+    Py_ssize_t length;           ///< In bytes
+    std::vector<Py_ssize_t> shape;
+    std::vector<Py_ssize_t> strides;
+};
+
+struct ArrayObject {
+    PyObject_HEAD
+    ArrayState * state;
+};
+
+int arrayGetBuffer(PyObject * self, Py_buffer * view, int flags)
+{
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "MLDB arrays are read-only");
+        view->obj = nullptr;
+        return -1;
+    }
+
+    const ArrayState & state = *reinterpret_cast<ArrayObject *>(self)->state;
+
+    view->buf = const_cast<void *>(state.data);
+    view->obj = self;
+    Py_INCREF(self);
+    view->len = state.length;
+    view->readonly = 1;
+    view->itemsize = state.itemSize;
+    view->format = (flags & PyBUF_FORMAT)
+        ? const_cast<char *>(state.format.c_str()) : nullptr;
+    view->ndim = state.shape.size();
+    view->shape = (flags & PyBUF_ND)
+        ? const_cast<Py_ssize_t *>(state.shape.data()) : nullptr;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES)
+        ? const_cast<Py_ssize_t *>(state.strides.data()) : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = nullptr;
+    return 0;
+}
+
+void arrayDealloc(PyObject * self)
+{
+    delete reinterpret_cast<ArrayObject *>(self)->state;
+    Py_TYPE(self)->tp_free(self);
+}
+
+PyBufferProcs arrayBufferProcs = { arrayGetBuffer, nullptr };
+
+PyTypeObject arrayType = { PyVarObject_HEAD_INIT(nullptr, 0) };
+
+void initArrayType(const EnterThreadToken & thread)
+{
+    arrayType.tp_name = "mldb.Array";
+    arrayType.tp_basicsize = sizeof(ArrayObject);
+    arrayType.tp_dealloc = arrayDealloc;
+    arrayType.tp_as_buffer = &arrayBufferProcs;
+    arrayType.tp_flags = Py_TPFLAGS_DEFAULT;
+    arrayType.tp_doc = "Array held by MLDB, readable through the buffer "
+        "protocol (eg with numpy.asarray)";
+    if (PyType_Ready(&arrayType) < 0)
+        throw AnnotatedException(500, "Couldn't initialize Python array type");
+}
+
+RegisterPythonInitializer regArrayType(&initArrayType);
+
+} // file scope
+
+
+/*****************************************************************************/
+/* ARRAY TO PYTHON                                                           */
+/*****************************************************************************/
+
+PyObject * arrayToPython(std::shared_ptr<const void> owner,
+                         const void * data,
+                         const char * format,
+                         size_t itemSize,
+                         std::vector<Py_ssize_t> shape)
+{
+    std::unique_ptr<ArrayState> state(new ArrayState());
+    state->owner = std::move(owner);
+    state->data = data;
+    state->format = format;
+    state->itemSize = itemSize;
+    state->strides.resize(shape.size());
+
+    Py_ssize_t stride = itemSize;
+    for (ssize_t i = shape.size() - 1;  i >= 0;  --i) {
+        state->strides[i] = stride;
+        stride *= shape[i];
+    }
+    state->length = stride;
+    state->shape = std::move(shape);
+
+    ArrayObject * result = PyObject_New(ArrayObject, &arrayType);
+    if (!result)
+        throw std::bad_alloc();
+    result->state = state.release();
+    return reinterpret_cast<PyObject *>(result);
+}
+
+PyObject * arrayToPython(std::vector<double> values,
+                         std::vector<Py_ssize_t> shape)
+{
+    auto owner = std::make_shared<std::vector<double> >(std::move(values));
+    const double * data = owner->data();
+    return arrayToPython(std::move(owner), data, "d", sizeof(double),
+                         std::move(shape));
+}
+
+
+/*****************************************************************************/
+/* ARRAY FROM PYTHON                                                         */
+/*****************************************************************************/
+
+ArrayFromPython::
+ArrayFromPython(PyObject * obj)
+{
+    if (PyObject_GetBuffer(obj, &buffer, PyBUF_RECORDS_RO) != 0) {
+        PyErr_Clear();
+        throw AnnotatedException
+            (400, "Expected an array, such as a numpy array, that supports "
+             "the buffer protocol",
+             "type", string(Py_TYPE(obj)->tp_name));
+    }
+
+    // Only native byte order and alignment, with one item per element
+    const char * format = buffer.format ? buffer.format : "B";
+    if (format[0] == '@')
+        ++format;
+    type = format[0];
+    if (!type || format[1] != 0 || !strchr("bBhHiIlLqQfd?", type)) {
+        string fmt = buffer.format ? buffer.format : "";
+        PyBuffer_Release(&buffer);
+        throw AnnotatedException
+            (400, "Arrays must be of a native numeric type",
+             "format", fmt);
+    }
+}
+
+ArrayFromPython::
+~ArrayFromPython()
+{
+    PyBuffer_Release(&buffer);
+}
+
+size_t
+ArrayFromPython::
+shape(int dim) const
+{
+    ExcAssertLess(dim, buffer.ndim);
+    return buffer.shape[dim];
+}
+
+template<typename T>
+void
+ArrayFromPython::
+getRowT(size_t row, T * out) const
+{
+    if (buffer.ndim != 1 && buffer.ndim != 2) {
+        throw AnnotatedException
+            (400, "Expected an array with one or two dimensions",
+             "dimensions", buffer.ndim);
+    }
+
+    size_t numRows = buffer.ndim == 1 ? 1 : buffer.shape[0];
+    ExcAssertLess(row, numRows);
+    size_t n = buffer.shape[buffer.ndim - 1];
+    Py_ssize_t stride = buffer.strides[buffer.ndim - 1];
+    const char * p = (const char *)buffer.buf
+        + (buffer.ndim == 1 ? 0 : row * buffer.strides[0]);
+
+    auto copy = [&] (auto * dummy)
+        {
+            typedef std::remove_pointer_t<decltype(dummy)> Item;
+            for (size_t i = 0;  i < n;  ++i, p += stride) {
+                Item item;
+                std::memcpy(&item, p, sizeof(item));  // may be unaligned
+                out[i] = item;
+            }
+        };
+
+    switch (type) {
+    case 'b': copy((signed char *)0);  break;
+    case 'B': copy((unsigned char *)0);  break;
+    case '?': copy((bool *)0);  break;
+    case 'h': copy((short *)0);  break;
+    case 'H': copy((unsigned short *)0);  break;
+    case 'i': copy((int *)0);  break;
+    case 'I': copy((unsigned int *)0);  break;
+    case 'l': copy((long *)0);  break;
+    case 'L': copy((unsigned long *)0);  break;
+    case 'q': copy((long long *)0);  break;
+    case 'Q': copy((unsigned long long *)0);  break;
+    case 'f': copy((float *)0);  break;
+    case 'd': copy((double *)0);  break;
+    default:
+        throw AnnotatedException(500, "Unexpected array type");
+    }
+}
+
+void
+ArrayFromPython::
+getRow(size_t row, float * out) const
+{
+    getRowT(row, out);
+}
+
+void
+ArrayFromPython::
+getRow(size_t row, double * out) const
+{
+    getRowT(row, out);
+}
+
+} // namespace Python
+} // namespace MLDB
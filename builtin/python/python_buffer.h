@@ -0,0 +1,86 @@
+/** python_buffer.h                                                -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Exchange of arrays with Python through the buffer protocol, so that
+    numpy arrays can be used without converting each element.
+*/
+
+#pragma once
+
+#include "Python.h"
+#include <memory>
+#include <vector>
+
+
+namespace MLDB {
+
+namespace Python {
+
+
+/*****************************************************************************/
+/* ARRAY TO PYTHON                                                           */
+/*****************************************************************************/
+
+/** Return a new reference to a read-only Python object that exposes the
+    given array through the buffer protocol, without copying it; for
+    example numpy.asarray() or memoryview() of it use the memory in place.
+    The owner is kept alive until the last view of the array is released.
+
+    The format is a struct module format character, eg "d" for doubles,
+    and the array is dense in row major order.
+*/
+PyObject * arrayToPython(std::shared_ptr<const void> owner,
+                         const void * data,
+                         const char * format,
+                         size_t itemSize,
+                         std::vector<Py_ssize_t> shape);
+
+/// Same, for an array of doubles that is moved into the Python object
+PyObject * arrayToPython(std::vector<double> values,
+                         std::vector<Py_ssize_t> shape);
+
+
+/*****************************************************************************/
+/* ARRAY FROM PYTHON                                                         */
+/*****************************************************************************/
+
+/** View of the contents of a Python object that supports the buffer
+    protocol, such as a numpy array, memoryview or array.array.  Numbers of
+    any native integer or floating point type, with any strides, are
+    read without creating a Python object for each one.  The GIL must be
+    held while the view exists.
+*/
+
+struct ArrayFromPython {
+    /// Throws if the object doesn't expose a numeric buffer
+    ArrayFromPython(PyObject * obj);
+    ~ArrayFromPython();
+
+    ArrayFromPython(const ArrayFromPython &) = delete;
+    void operator = (const ArrayFromPython &) = delete;
+
+    /// Number of dimensions
+    int ndim() const
+    {
+        return buffer.ndim;
+    }
+
+    /// Length of the given dimension
+    size_t shape(int dim) const;
+
+    /** Copy the row with the given index of a two dimensional array
+        (or the whole of a one dimensional array, for row 0) into out,
+        which must hold shape(1) (or shape(0)) elements.
+    */
+    void getRow(size_t row, float * out) const;
+    void getRow(size_t row, double * out) const;
+
+private:
+    Py_buffer buffer;
+    char type;
+
+    template<typename T> void getRowT(size_t row, T * out) const;
+};
+
+} // namespace Python
+} // namespace MLDB
@@ -14,6 +14,8 @@
 #include "python_converters.h"
 #include "from_python_converter.h"
 #include "callback.h"
+#include "python_buffer.h"
+#include "mldb/types/annotated_exception.h"
 #include <boost/python/to_python_converter.hpp>
 
 
@@ -76,6 +78,38 @@ recordColumns(const std::vector<std::pair<ColumnPath, std::vector<ColumnCellTupl
     dataset->recordColumns(columns);
 }
     
+void DatasetPy::
+recordEmbedding(const std::vector<ColumnPath> & columnNames,
+                const std::vector<RowPath> & rowNames,
+                const boost::python::object & array,
+                Date ts)
+{
+    std::vector<std::tuple<RowPath, std::vector<float>, Date> > rows;
+    {
+        Python::ArrayFromPython values(array.ptr());
+        if (values.ndim() != 2
+            || values.shape(0) != rowNames.size()
+            || values.shape(1) != columnNames.size()) {
+            throw AnnotatedException
+                (400, "record_embedding needs an array with a row for each "
+                 "row name and a column for each column name",
+                 "numRowNames", rowNames.size(),
+                 "numColumnNames", columnNames.size(),
+                 "arrayDimensions", values.ndim());
+        }
+
+        rows.reserve(rowNames.size());
+        for (size_t i = 0;  i < rowNames.size();  ++i) {
+            std::vector<float> embedding(columnNames.size());
+            values.getRow(i, embedding.data());
+            rows.emplace_back(rowNames[i], std::move(embedding), ts);
+        }
+    }
+
+    auto nogil = releaseGil();
+    dataset->recordEmbedding(columnNames, rows);
+}
+
 void DatasetPy::
 commit() {
     auto nogil = releaseGil();
@@ -231,11 +265,14 @@ void pythonEntitiesInit(const EnterThreadToken & thread)
     from_python_converter< std::vector<std::pair<ColumnPath, std::vector<ColumnCellTuple> > >,
                            VectorConverter<std::pair<ColumnPath, std::vector<ColumnCellTuple> > > >();
 
+    from_python_converter< std::vector<Path>, VectorConverter<Path> >();
+
     bp::class_<DatasetPy>("dataset", bp::no_init)
         .def("record_row", &DatasetPy::recordRow)
         .def("record_rows", &DatasetPy::recordRows)
         .def("record_column", &DatasetPy::recordColumn)
         .def("record_columns", &DatasetPy::recordColumns)
+        .def("record_embedding", &DatasetPy::recordEmbedding)
         .def("commit", &DatasetPy::commit);
 
     bp::class_<FunctionInfo, boost::noncopyable>("function_info", bp::no_init)
@@ -43,6 +43,16 @@ struct DatasetPy {
                       const std::vector<ColumnCellTuple> & rows);
     void recordColumns(const std::vector<std::pair<ColumnPath, std::vector<ColumnCellTuple> > > & columns);
 
+    /** Record one row per row of the two dimensional array, which may be
+        any object that supports the buffer protocol (eg, a numpy array),
+        with one column per column of the array.  The values are read
+        from the array without converting each of them to Python.
+    */
+    void recordEmbedding(const std::vector<ColumnPath> & columnNames,
+                         const std::vector<RowPath> & rowNames,
+                         const boost::python::object & array,
+                         Date ts);
+
     void commit();
     
     std::shared_ptr<Dataset> dataset;
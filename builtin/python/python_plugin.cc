@@ -511,6 +511,7 @@ void pythonLoaderInit(const EnterThreadToken & thread)
     mldb.def("read_lines", &MldbPythonContext::readLines);
     mldb.def("read_lines", &MldbPythonContext::readLines1);
     mldb.def("ls", &MldbPythonContext::ls);
+    mldb.def("query_array", &MldbPythonContext::queryArray);
     mldb.def("get_http_bound_address", &MldbPythonContext::getHttpBoundAddress);
 
 
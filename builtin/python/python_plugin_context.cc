@@ -20,6 +20,10 @@
 #include "frameobject.h"
 #include "pointer_fix.h"
 #include "capture_stream.h"
+#include "python_buffer.h"
+#include "mldb/engine/analytics.h"
+#include "mldb/engine/dataset_scope.h"
+#include "mldb/sql/sql_expression.h"
 
 using namespace std;
 
@@ -816,6 +820,49 @@ ls(const std::string & dir)
     return result;
 }
 
+boost::python::tuple
+MldbPythonContext::
+queryArray(const Utf8String & query)
+{
+    namespace bp = boost::python;
+
+    std::vector<double> values;
+    std::vector<RowPath> rowNames;
+    std::vector<ColumnPath> columnNames;
+    {
+        auto nogil = releaseGil();
+
+        SelectStatement stm = SelectStatement::parse(query);
+        SqlExpressionMldbScope context(getPyContext()->engine);
+        auto embedding = getEmbedding(stm, context);
+
+        for (auto & c: embedding.second)
+            columnNames.emplace_back(c.columnName);
+
+        values.reserve(embedding.first.size() * columnNames.size());
+        rowNames.reserve(embedding.first.size());
+        for (auto & row: embedding.first) {
+            const std::vector<double> & rowValues = std::get<2>(row);
+            ExcAssertEqual(rowValues.size(), columnNames.size());
+            values.insert(values.end(), rowValues.begin(), rowValues.end());
+            rowNames.emplace_back(std::move(std::get<1>(row)));
+        }
+    }
+
+    bp::list pyRowNames, pyColumnNames;
+    for (auto & r: rowNames)
+        pyRowNames.append(r.toUtf8String());
+    for (auto & c: columnNames)
+        pyColumnNames.append(c.toUtf8String());
+
+    Py_ssize_t numRows = rowNames.size(), numColumns = columnNames.size();
+    bp::object array(bp::handle<>(Python::arrayToPython
+                                  (std::move(values),
+                                   { numRows, numColumns })));
+
+    return bp::make_tuple(pyRowNames, pyColumnNames, array);
+}
+
 string
 MldbPythonContext::
 getHttpBoundAddress()
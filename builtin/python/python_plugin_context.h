@@ -270,6 +270,14 @@ struct MldbPythonContext {
     Json::Value
     ls(const std::string & path);
 
+    /** Run a query and return its result as a tuple of the row names, the
+        column names and a two dimensional array of doubles (one row per
+        row) that is exposed through the buffer protocol, so that numpy
+        can use it without converting each value.
+    */
+    boost::python::tuple
+    queryArray(const Utf8String & query);
+
     std::string getHttpBoundAddress();
 
 private:
@@ -16,7 +16,6 @@
 #include "mldb/sql/execution_pipeline.h"
 #include "mldb/arch/backtrace.h"
 #include "mldb/types/any_impl.h"
-#include "mldb/base/per_thread_accumulator.h"
 #include "mldb/types/date.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/builtin/sql_config_validator.h"
@@ -134,58 +133,39 @@ run(const ProcedureRunConfig & run,
                                 nullptr, true /*overwrite*/);
 
     typedef tuple<ColumnPath, CellValue, Date> Cell;
-    PerThreadAccumulator<vector<pair<RowPath, vector<Cell> > > > accum;
     const ColumnPath columnName(runProcConf.rankingColumnName);
-    function<void(int64_t)> applyFct;
-    float countD100 = (rowCount) / 100.0;
-    if (false) {
-    //if (runProcConf.rankingType == RankingType::PERCENTILE) {
-        // Improper implementation, see
-        // https://en.wikipedia.org/wiki/Percentile_rank
-        applyFct = [&](int64_t idx)
-        {
-            vector<Cell> rowValue;
-            rowValue.emplace_back(columnName,
-                                  (idx + 1) / countD100,
-                                  globalMaxOrderByTimestamp);
+    ExcAssert(runProcConf.rankingType == RankingType::INDEX);
 
-            auto & rows = accum.get();
-            rows.emplace_back(orderedRowNames[idx], rowValue);
+    // Each block of ranks is recorded as its own chunk, so that the output
+    // is written in parallel and comes out the same each time
+    Dataset::MultiChunkRecorder recorder = output->getChunkRecorder();
+    static constexpr size_t RANKS_PER_CHUNK = 16384;
+    size_t numChunks = (rowCount + RANKS_PER_CHUNK - 1) / RANKS_PER_CHUNK;
 
-            if (rows.size() >= 1024) {
-                output->recordRows(rows);
-                rows.clear();
-            }
-        };
-    }
-    else {
-        ExcAssert(runProcConf.rankingType == RankingType::INDEX);
-        applyFct = [&](int64_t idx)
-        {
+    auto recordChunk = [&] (size_t chunk)
+    {
+        size_t begin = chunk * RANKS_PER_CHUNK;
+        size_t end = std::min<size_t>(begin + RANKS_PER_CHUNK, rowCount);
+
+        vector<pair<RowPath, vector<Cell> > > rows;
+        rows.reserve(end - begin);
+        for (size_t idx = begin;  idx < end;  ++idx) {
             vector<Cell> rowValue;
             rowValue.emplace_back(columnName,
-                                  idx,
+                                  (int64_t)idx,
                                   globalMaxOrderByTimestamp);
+            rows.emplace_back(std::move(orderedRowNames[idx]),
+                              std::move(rowValue));
+        }
 
-            auto & rows = accum.get();
-            rows.emplace_back(orderedRowNames[idx], rowValue);
-
-            if (rows.size() >= 1024) {
-                output->recordRows(rows);
-                rows.clear();
-            }
-        };
-    }
-
+        auto chunkRecorder = recorder.newChunk(chunk);
+        chunkRecorder->recordRowsDestructive(std::move(rows));
+        chunkRecorder->finishedChunk();
+    };
 
-    parallelMap(0, rowCount, applyFct);
+    parallelMap(0, numChunks, recordChunk);
 
-    // record remainder
-    accum.forEach([&] (vector<pair<RowPath, vector<Cell> > > * rows)
-    {
-        output->recordRows(*rows);
-    });
-    output->commit();
+    recorder.commit();
     return output->getStatus();
 }
 
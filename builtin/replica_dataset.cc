@@ -0,0 +1,450 @@
+/** replica_dataset.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Read replicas of immutable datasets made from published snapshots.
+*/
+
+#include "replica_dataset.h"
+#include "mldb/core/mldb_engine.h"
+#include "mldb/base/hash.h"
+#include "mldb/rest/in_process_rest_connection.h"
+#include "mldb/rest/rest_request_params.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/utils/log.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/watch/watch_impl.h"
+#include <mutex>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SNAPSHOT MANIFEST                                                         */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(SnapshotManifest);
+
+SnapshotManifestDescription::
+SnapshotManifestDescription()
+{
+    addField("version", &SnapshotManifest::version,
+             "Version of the snapshot, which increases with each one "
+             "published");
+    addField("published", &SnapshotManifest::published,
+             "Time at which the snapshot was published");
+    addField("dataset", &SnapshotManifest::dataset,
+             "Configuration that loads the snapshot");
+}
+
+namespace {
+
+Utf8String getManifestUri(const Url & snapshotUrl)
+{
+    Utf8String result = snapshotUrl.toUtf8String();
+    if (!result.endsWith("/"))
+        result += "/";
+    return result + "manifest.json";
+}
+
+/// Read the manifest of the directory, or return version 0 if it has none
+SnapshotManifest readManifest(const Url & snapshotUrl)
+{
+    Utf8String uri = getManifestUri(snapshotUrl);
+    if (!tryGetUriObjectInfo(uri.rawString()))
+        return SnapshotManifest();
+
+    filter_istream stream(uri.rawString());
+    std::ostringstream contents;
+    contents << stream.rdbuf();
+    return jsonDecodeStr<SnapshotManifest>(contents.str());
+}
+
+/// Copy the object at one URI to another
+void copyUri(const std::string & from, const std::string & to)
+{
+    filter_istream in(from);
+    filter_ostream out(to);
+    out << in.rdbuf();
+    out.close();
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* SNAPSHOT PUBLISH PROCEDURE                                                */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(SnapshotPublishProcedureConfig);
+
+SnapshotPublishProcedureConfigDescription::
+SnapshotPublishProcedureConfigDescription()
+{
+    addField("dataset", &SnapshotPublishProcedureConfig::dataset,
+             "Dataset to publish a snapshot of");
+    addField("snapshotUrl", &SnapshotPublishProcedureConfig::snapshotUrl,
+             "Directory that holds the snapshots.  Each one is put in a "
+             "subdirectory named after its version, and manifest.json "
+             "points to the latest one.");
+    addParent<ProcedureConfig>();
+}
+
+SnapshotPublishProcedure::
+SnapshotPublishProcedure(MldbEngine * owner,
+                         PolyConfig config,
+                         const std::function<bool (const Json::Value &)> & onProgress)
+    : Procedure(owner)
+{
+    procedureConfig = config.params.convert<SnapshotPublishProcedureConfig>();
+}
+
+RunOutput
+SnapshotPublishProcedure::
+run(const ProcedureRunConfig & run,
+    const std::function<bool (const Json::Value &)> & onProgress) const
+{
+    auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
+    if (runProcConf.snapshotUrl.empty())
+        throw AnnotatedException(400, "snapshot.publish needs a snapshotUrl");
+
+    auto dataset = obtainDataset(engine, runProcConf.dataset);
+
+    SnapshotManifest manifest;
+    manifest.version = readManifest(runProcConf.snapshotUrl).version + 1;
+
+    Utf8String snapshotDir = runProcConf.snapshotUrl.toUtf8String();
+    if (!snapshotDir.endsWith("/"))
+        snapshotDir += "/";
+    snapshotDir += to_string(manifest.version) + "/";
+    Url dataFileUrl(snapshotDir + "data");
+
+    // Datasets that can save themselves produce a frozen copy, which is
+    // what the replicas load
+    bool saved = false;
+    if (!dataset->getId().empty()) {
+        Json::Value body;
+        body["dataFileUrl"] = dataFileUrl.toUtf8String();
+        RestRequest request("POST",
+                            "/v1/datasets/"
+                            + encodeUriComponent(dataset->getId()).rawString()
+                            + "/routes/saves",
+                            RestParams(), body.toStringNoNewLine());
+        auto connection = InProcessRestConnection::create();
+        engine->handleRequest(*connection, request);
+        connection->waitForResponse();
+
+        if (connection->responseCode() == 200) {
+            manifest.dataset = jsonDecodeStr<PolyConfigT<Dataset> >
+                (connection->response());
+            saved = true;
+        }
+        else if (connection->responseCode() != 404) {
+            throw AnnotatedException(connection->responseCode(),
+                                     "Error saving dataset for snapshot",
+                                     "dataset", dataset->getId(),
+                                     "response", connection->response());
+        }
+    }
+
+    // Datasets that are loaded from a file are already frozen, and it's
+    // only their file that needs to be copied
+    if (!saved) {
+        const PolyConfig & config = dataset->getConfig();
+        Json::Value params = config.params.asJson();
+        if (!params.isMember("dataFileUrl")) {
+            throw AnnotatedException
+                (400, "Dataset can't be published as a snapshot, as it has "
+                 "neither a saves route nor a dataFileUrl",
+                 "dataset", dataset->getId(),
+                 "type", dataset->getType());
+        }
+        makeUriDirectory(dataFileUrl.toDecodedString());
+        copyUri(Url(params["dataFileUrl"].asString()).toDecodedString(),
+                dataFileUrl.toDecodedString());
+        params["dataFileUrl"] = dataFileUrl.toUtf8String();
+        manifest.dataset.type = config.type;
+        manifest.dataset.params = params;
+    }
+
+    // The manifest is written last, so that replicas never see a snapshot
+    // that isn't complete
+    manifest.published = Date::now();
+    {
+        filter_ostream out(getManifestUri(runProcConf.snapshotUrl).rawString());
+        out << jsonEncodeStr(manifest);
+        out.close();
+    }
+
+    return RunOutput(manifest);
+}
+
+Any
+SnapshotPublishProcedure::
+getStatus() const
+{
+    return Any();
+}
+
+static RegisterProcedureType<SnapshotPublishProcedure,
+                             SnapshotPublishProcedureConfig>
+regSnapshotPublish(builtinPackage(),
+                   "Publish a frozen snapshot of a dataset for read replicas",
+                   "procedures/SnapshotPublishProcedure.md.html");
+
+
+/*****************************************************************************/
+/* REPLICA DATASET                                                           */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(ReplicaDatasetConfig);
+
+ReplicaDatasetConfigDescription::
+ReplicaDatasetConfigDescription()
+{
+    addField("snapshotUrl", &ReplicaDatasetConfig::snapshotUrl,
+             "Directory that snapshots are published to by the "
+             "snapshot.publish procedure");
+    addField("pollInterval", &ReplicaDatasetConfig::pollInterval,
+             "Number of seconds between checks for a new snapshot.  Zero "
+             "loads the latest snapshot when the dataset is created and "
+             "never checks again.",
+             10.0);
+}
+
+static RegisterDatasetType<ReplicaDataset, ReplicaDatasetConfig>
+regReplica(builtinPackage(),
+           "replica",
+           "Read replica of a dataset published as snapshots",
+           "datasets/ReplicaDataset.md.html");
+
+struct ReplicaDataset::Itl {
+    Itl(ReplicaDataset * owner, ReplicaDatasetConfig config)
+        : owner(owner), engine(owner->engine), config(std::move(config)),
+          logger(MLDB::getMldbLog<ReplicaDataset>())
+    {
+        if (this->config.snapshotUrl.empty())
+            throw AnnotatedException(400, "Replica dataset needs a "
+                                     "snapshotUrl");
+
+        if (!update()) {
+            throw AnnotatedException(400, "No snapshot has been published "
+                                     "for replica dataset",
+                                     "snapshotUrl", this->config.snapshotUrl);
+        }
+
+        if (this->config.pollInterval > 0) {
+            timer = engine->getTimer(Date::now().plusSeconds(this->config.pollInterval),
+                                     this->config.pollInterval,
+                                     [=] (Date date)
+                                     {
+                                         poll();
+                                     });
+        }
+    }
+
+    ~Itl()
+    {
+        if (!localFile.empty())
+            ::unlink(localFile.c_str());
+    }
+
+    ReplicaDataset * owner;
+    MldbEngine * engine;
+    ReplicaDatasetConfig config;
+    shared_ptr<spdlog::logger> logger;
+    WatchT<Date> timer;
+
+    /// Held while loading a snapshot, so that only one is loaded at once
+    std::mutex updateMutex;
+
+    mutable std::mutex mutex;
+    std::shared_ptr<Dataset> current;
+    SnapshotManifest manifest;
+    std::string localFile;      ///< Local copy of the current snapshot
+    Date lastCheck;
+    std::string lastError;
+
+    std::shared_ptr<Dataset> getCurrent() const
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        return current;
+    }
+
+    void poll()
+    {
+        try {
+            update();
+            std::unique_lock<std::mutex> guard(mutex);
+            lastError.clear();
+        } MLDB_CATCH_ALL {
+            // Keep serving the current snapshot and try again next time
+            std::string error = getExceptionString();
+            ERROR_MSG(logger) << "error updating replica from "
+                              << config.snapshotUrl.toString() << ": "
+                              << error;
+            std::unique_lock<std::mutex> guard(mutex);
+            lastError = error;
+        }
+    }
+
+    /** Load the latest snapshot if it's newer than the current one, and
+        switch over to it.  Returns false if there is no snapshot yet.
+    */
+    bool update()
+    {
+        std::unique_lock<std::mutex> updateGuard(updateMutex);
+
+        SnapshotManifest latest = readManifest(config.snapshotUrl);
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            lastCheck = Date::now();
+            if (latest.version <= manifest.version)
+                return manifest.version > 0;
+        }
+
+        PolyConfig toLoad = latest.dataset;
+        std::string newLocalFile = localize(toLoad, latest.version);
+        std::shared_ptr<Dataset> loaded;
+        try {
+            loaded = obtainDataset(engine, toLoad);
+        } catch (...) {
+            if (!newLocalFile.empty())
+                ::unlink(newLocalFile.c_str());
+            throw;
+        }
+
+        INFO_MSG(logger) << "replica of " << config.snapshotUrl.toString()
+                         << " switching to version " << latest.version;
+
+        std::string oldLocalFile;
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            current = loaded;
+            manifest = std::move(latest);
+            oldLocalFile = std::move(localFile);
+            localFile = std::move(newLocalFile);
+        }
+        owner->setUnderlying(std::move(loaded));
+
+        // Queries still running on the old version keep it mapped
+        if (!oldLocalFile.empty())
+            ::unlink(oldLocalFile.c_str());
+
+        return true;
+    }
+
+    /** If the snapshot's file isn't local, copy it to the cache directory
+        and point the configuration to the copy, so that it can be memory
+        mapped.  Returns the name of the copy, or an empty string if none
+        was made.
+    */
+    std::string localize(PolyConfig & toLoad, int64_t version) const
+    {
+        std::string cacheDir = engine->getCacheDirectory();
+        Json::Value params = toLoad.params.asJson();
+        if (cacheDir.empty() || !params.isMember("dataFileUrl"))
+            return string();
+
+        Url dataFileUrl(params["dataFileUrl"].asString());
+        if (dataFileUrl.scheme() == "file")
+            return string();
+
+        string dir = cacheDir + "/replicas";
+        ::mkdir(dir.c_str(), 0777);
+        string file = dir + "/" + md5HashToHex(dataFileUrl.toDecodedString())
+            + "-" + to_string(version);
+
+        // Copy under a temporary name, so that a partial copy is never
+        // loaded
+        string tmpFile = file + ".tmp";
+        try {
+            copyUri(dataFileUrl.toDecodedString(), "file://" + tmpFile);
+        } catch (...) {
+            ::unlink(tmpFile.c_str());
+            throw;
+        }
+        if (::rename(tmpFile.c_str(), file.c_str()) == -1) {
+            ::unlink(tmpFile.c_str());
+            throw AnnotatedException(500, "Couldn't move snapshot into the "
+                                     "cache directory",
+                                     "file", file,
+                                     "error", string(strerror(errno)));
+        }
+
+        params["dataFileUrl"] = "file://" + file;
+        toLoad.params = params;
+        return file;
+    }
+
+    Json::Value getStatus() const
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        Json::Value result;
+        result["snapshotUrl"] = config.snapshotUrl.toUtf8String();
+        result["version"] = manifest.version;
+        result["published"] = jsonEncode(manifest.published);
+        result["lastCheck"] = jsonEncode(lastCheck);
+        if (!lastError.empty())
+            result["lastError"] = lastError;
+        if (current)
+            result["dataset"] = jsonEncode(current->getStatus());
+        return result;
+    }
+};
+
+ReplicaDataset::
+ReplicaDataset(MldbEngine * owner,
+               PolyConfig config,
+               const ProgressFunc & onProgress)
+    : ForwardedDataset(owner)
+{
+    datasetConfig = config.params.convert<ReplicaDatasetConfig>();
+    itl.reset(new Itl(this, datasetConfig));
+}
+
+ReplicaDataset::
+~ReplicaDataset()
+{
+}
+
+Any
+ReplicaDataset::
+getStatus() const
+{
+    return itl->getStatus();
+}
+
+bool
+ReplicaDataset::
+queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onRow,
+                           const SelectExpression & select,
+                           const WhenExpression & when,
+                           const SqlExpression & where,
+                           const OrderByExpression & orderBy,
+                           const TupleExpression & groupBy,
+                           const std::shared_ptr<SqlExpression> having,
+                           const std::shared_ptr<SqlExpression> rowName,
+                           ssize_t offset,
+                           ssize_t limit,
+                           Utf8String alias,
+                           const ProgressFunc & onProgress) const
+{
+    return itl->getCurrent()->queryStructuredIncremental
+        (onRow, select, when, where, orderBy, groupBy, having, rowName,
+         offset, limit, alias, onProgress);
+}
+
+} // namespace MLDB
@@ -0,0 +1,122 @@
+/** replica_dataset.h                                             -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Read replicas of immutable datasets, made from snapshots that one MLDB
+    instance publishes and others load.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/core/procedure.h"
+#include "mldb/engine/forwarded_dataset.h"
+#include "mldb/types/url.h"
+#include "mldb/types/value_description_fwd.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SNAPSHOT MANIFEST                                                         */
+/*****************************************************************************/
+
+/** Describes the latest snapshot in a snapshot directory.  It's kept in
+    the manifest.json file of the directory, and is rewritten each time a
+    new snapshot is published.
+*/
+struct SnapshotManifest {
+    int64_t version = 0;         ///< Increases with each snapshot
+    Date published;              ///< When it was published
+    PolyConfigT<Dataset> dataset;  ///< Loads the frozen dataset
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(SnapshotManifest);
+
+
+/*****************************************************************************/
+/* SNAPSHOT PUBLISH PROCEDURE                                                */
+/*****************************************************************************/
+
+struct SnapshotPublishProcedureConfig : ProcedureConfig {
+    static constexpr const char * name = "snapshot.publish";
+
+    PolyConfigT<const Dataset> dataset;
+    Url snapshotUrl;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(SnapshotPublishProcedureConfig);
+
+/** Freezes a dataset into a new version of a snapshot directory.  Datasets
+    with a saves route (such as tabular and beh.binary.mutable) are saved
+    into it; datasets loaded from a dataFileUrl (such as beh and
+    embedding.mapped) have their file copied into it.
+*/
+struct SnapshotPublishProcedure: public Procedure {
+
+    SnapshotPublishProcedure(MldbEngine * owner,
+                             PolyConfig config,
+                             const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual RunOutput run(const ProcedureRunConfig & run,
+                          const std::function<bool (const Json::Value &)> & onProgress) const;
+
+    virtual Any getStatus() const;
+
+    SnapshotPublishProcedureConfig procedureConfig;
+};
+
+
+/*****************************************************************************/
+/* REPLICA DATASET                                                           */
+/*****************************************************************************/
+
+struct ReplicaDatasetConfig {
+    Url snapshotUrl;
+    double pollInterval = 10;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(ReplicaDatasetConfig);
+
+/** Read-only dataset that serves the latest snapshot of a snapshot
+    directory.  The directory is checked for a new version every
+    pollInterval seconds; when there is one, it's loaded in the background
+    and then swapped in, so that queries that are running finish on the
+    version they started with.  Snapshots that aren't on the local
+    filesystem are first copied to the cache directory, so that they can
+    be memory mapped.
+*/
+struct ReplicaDataset: public ForwardedDataset {
+
+    ReplicaDataset(MldbEngine * owner,
+                   PolyConfig config,
+                   const ProgressFunc & onProgress);
+
+    virtual ~ReplicaDataset() override;
+
+    virtual Any getStatus() const override;
+
+    /** Run the whole query over the snapshot that is current when it
+        starts.
+    */
+    virtual bool
+    queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onRow,
+                               const SelectExpression & select,
+                               const WhenExpression & when,
+                               const SqlExpression & where,
+                               const OrderByExpression & orderBy,
+                               const TupleExpression & groupBy,
+                               const std::shared_ptr<SqlExpression> having,
+                               const std::shared_ptr<SqlExpression> rowName,
+                               ssize_t offset,
+                               ssize_t limit,
+                               Utf8String alias = "",
+                               const ProgressFunc & onProgress = nullptr) const override;
+
+private:
+    ReplicaDatasetConfig datasetConfig;
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
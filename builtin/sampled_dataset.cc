@@ -11,6 +11,8 @@
 #include "mldb/types/structure_description.h"
 #include "mldb/engine/dataset_scope.h"
 #include "mldb/types/annotated_exception.h"
+#include "mldb/base/parallel.h"
+#include <algorithm>
 #include <random>
 #include <unordered_set>
 
@@ -94,63 +96,184 @@ SampledDatasetConfigDescription()
 /*****************************************************************************/
 
 
+/** Return numRows indexes of rows out of numAvailable, in increasing
+    order.  Without replacement, Floyd's algorithm is used, so that the
+    cost is proportional to the number of rows sampled and not to the
+    number available, unless most of the rows are asked for.  With
+    replacement, the same index may be returned more than once.
+*/
+static std::vector<uint64_t>
+sampleRowIndexes(uint64_t numAvailable, uint64_t numRows,
+                 bool withReplacement, unsigned seed)
+{
+    std::vector<uint64_t> result;
+    result.reserve(numRows);
+
+    std::mt19937_64 gen(seed);
+
+    if (withReplacement) {
+        std::uniform_int_distribution<uint64_t> dis(0, numAvailable - 1);
+        while (result.size() < numRows)
+            result.push_back(dis(gen));
+    }
+    else if (numRows > numAvailable / 2) {
+        // Most of the rows; cheaper to decide on each of them in turn
+        std::uniform_real_distribution<double> dis(0, 1);
+        for (uint64_t i = 0;  result.size() < numRows;  ++i) {
+            uint64_t needed = numRows - result.size();
+            if (dis(gen) * (numAvailable - i) < needed)
+                result.push_back(i);
+        }
+    }
+    else {
+        std::unordered_set<uint64_t> chosen;
+        chosen.reserve(numRows);
+        for (uint64_t j = numAvailable - numRows;  j < numAvailable;  ++j) {
+            uint64_t t = std::uniform_int_distribution<uint64_t>(0, j)(gen);
+            if (!chosen.insert(t).second) {
+                chosen.insert(j);
+                t = j;
+            }
+            result.push_back(t);
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
 struct SampledDataset::Itl
     : public MatrixView, public ColumnIndex {
 
+    /// Rows closer than this to the previous one are reached by advancing
+    /// the row stream rather than positioning it again
+    static constexpr uint64_t MAX_ADVANCE = 64;
+
     /// Dataset that it was constructed with
     std::shared_ptr<Dataset> dataset;
 
     std::shared_ptr<MatrixView> matrix;
     std::shared_ptr<ColumnIndex> index;
-    size_t columnCount;
 
     std::unordered_set<RowPath> sampledRowsIndex;
     std::vector<RowPath> sampledRows;
     std::vector<RowHash> sampledRowsHash;
 
+    struct SampledRowStream : public RowStream {
+
+        SampledRowStream(const SampledDataset::Itl * source)
+            : source(source), pos(0)
+        {
+        }
+
+        virtual std::shared_ptr<RowStream> clone() const
+        {
+            return std::make_shared<SampledRowStream>(source);
+        }
+
+        virtual void initAt(size_t start)
+        {
+            pos = start;
+        }
+
+        virtual RowPath next()
+        {
+            return source->sampledRows[pos++];
+        }
+
+        virtual const RowPath & rowName(RowPath & storage) const
+        {
+            return source->sampledRows[pos];
+        }
+
+        virtual void advance()
+        {
+            ++pos;
+        }
+
+    private:
+        const SampledDataset::Itl * source;
+        size_t pos;
+    };
+
     Itl(MldbEngine * engine, std::shared_ptr<Dataset> dataset,
             const SampledDatasetConfig config)
         : dataset(dataset),
           matrix(dataset->getMatrixView()),
-          index(dataset->getColumnIndex()),
-          columnCount(matrix->getColumnPaths().size())
+          index(dataset->getColumnIndex())
     {
-        // get all existing rows
-        auto rows = matrix->getRowHashes();
+        uint64_t numAvailable = matrix->getRowCount();
 
         unsigned numRows = config.rows != 0 ? config.rows
-                                            : rows.size() * config.fraction;
+                                            : numAvailable * config.fraction;
 
-        if(!config.withReplacement && numRows > rows.size()) {
+        if(!config.withReplacement && numRows > numAvailable) {
             throw MLDB::Exception("Requested more rows without replacement than "
                     "available number of rows in original dataset.");
         }
-        sampledRowsHash.reserve(numRows);
-        sampledRows.reserve(numRows);
+        if (numRows == 0)
+            return;
+        if (numAvailable == 0) {
+            throw MLDB::Exception("Can't sample rows from a dataset "
+                                  "without any rows.");
+        }
 
         // do the sampling
-        std::mt19937 gen(config.seed);
-        std::uniform_int_distribution<> dis(0, rows.size() - 1);
-
-        unordered_set<unsigned> sampledIndexes;
-        while(sampledRows.size() < numRows) {
-            unsigned sample_index = dis(gen);
-
-            // if we're not sampling with replacement, check if
-            // we already sampled this index
-            if(!config.withReplacement) {
-                if(sampledIndexes.count(sample_index))
-                    continue;
-
-                sampledIndexes.insert(sample_index);
-            }
-
-            sampledRowsHash.emplace_back(rows[sample_index]);
-
-            auto rowName = matrix->getRowPath(rows[sample_index]);
-            sampledRows.emplace_back(rowName);
-            sampledRowsIndex.insert(rowName);
+        std::vector<uint64_t> indexes
+            = sampleRowIndexes(numAvailable, numRows,
+                               config.withReplacement, config.seed);
+
+        sampledRowsHash.resize(numRows);
+        sampledRows.resize(numRows);
+
+        auto stream = dataset->getRowStream();
+        if (stream) {
+            // Only the sampled rows are visited, by positioning a stream
+            // on each one or advancing to it when it's close.  Chunks of
+            // the sample are done in parallel.
+            auto doChunk = [&] (size_t begin, size_t end)
+                {
+                    std::shared_ptr<RowStream> chunkStream;
+                    uint64_t pos = 0;  // index of row next() would return
+                    for (size_t i = begin;  i < end;  ++i) {
+                        uint64_t index = indexes[i];
+                        if (i > begin && index == indexes[i - 1]) {
+                            sampledRows[i] = sampledRows[i - 1];
+                        }
+                        else {
+                            if (!chunkStream || index < pos
+                                || index - pos > MAX_ADVANCE) {
+                                chunkStream = stream->clone();
+                                chunkStream->initAt(index);
+                                pos = index;
+                            }
+                            chunkStream->advanceBy(index - pos);
+                            sampledRows[i] = chunkStream->next();
+                            pos = index + 1;
+                        }
+                        sampledRowsHash[i] = sampledRows[i];
+                    }
+                };
+
+            parallelMapChunked(0, numRows, 1024, doChunk);
         }
+        else {
+            // No way to get at a row by its position without listing them
+            auto rows = matrix->getRowHashes();
+            ExcAssertEqual(rows.size(), numAvailable);
+            auto doChunk = [&] (size_t begin, size_t end)
+                {
+                    for (size_t i = begin;  i < end;  ++i) {
+                        sampledRowsHash[i] = rows[indexes[i]];
+                        sampledRows[i] = matrix->getRowPath(sampledRowsHash[i]);
+                    }
+                };
+
+            parallelMapChunked(0, numRows, 1024, doChunk);
+        }
+
+        sampledRowsIndex.reserve(numRows);
+        sampledRowsIndex.insert(sampledRows.begin(), sampledRows.end());
     }
 
     virtual RowPath getRowPath(const RowHash & row) const
@@ -162,36 +285,27 @@ struct SampledDataset::Itl
         return rowName;
     }
 
+    template<typename T>
+    static std::vector<T>
+    getRange(const std::vector<T> & all, ssize_t start, ssize_t limit)
+    {
+        if (start >= all.size())
+            return {};
+        size_t end = limit == -1
+            ? all.size() : std::min<size_t>(all.size(), start + limit);
+        return std::vector<T>(all.begin() + start, all.begin() + end);
+    }
+
     virtual std::vector<RowPath>
     getRowPaths(ssize_t start = 0, ssize_t limit = -1) const
     {
-        std::vector<RowPath> rtn;
-        rtn.reserve(sampledRows.size() - start);
-
-        for(int i=start; i<sampledRows.size(); i++) {
-            rtn.emplace_back(sampledRows[i]);
-
-            if(limit != -1 && rtn.size() > limit)
-                break;
-        }
-
-        return rtn;
+        return getRange(sampledRows, start, limit);
     }
 
     virtual std::vector<RowHash>
     getRowHashes(ssize_t start = 0, ssize_t limit = -1) const
     {
-        std::vector<RowHash> rtn;
-        rtn.reserve(sampledRows.size() - start);
-
-        for(int i=start; i<sampledRowsHash.size(); i++) {
-            rtn.emplace_back(sampledRowsHash[i]);
-
-            if(limit != -1 && rtn.size() > limit)
-                break;
-        }
-
-        return rtn;
+        return getRange(sampledRowsHash, start, limit);
     }
 
     virtual bool knownRow(const RowPath & row) const
@@ -253,20 +367,20 @@ struct SampledDataset::Itl
     {
         auto col = index->getColumn(column);
 
-        std::vector<std::tuple<RowPath, CellValue, Date> > allRows = std::move(col.rows);
-        map<RowPath, unsigned> rowIndex;
-        for(int i=0; i<allRows.size(); i++) {
-            rowIndex.insert(make_pair(get<0>(allRows[i]), i));
-        }
-
-
-        // std::vector<std::tuple<RowPath, CellValue, Date> > rows;
-        for(auto rowName : sampledRows) {
-            auto it = rowIndex.find(rowName);
-            if(it == rowIndex.end())
-                throw MLDB::Exception("Unknown row in index");
-
-            col.rows.emplace_back(allRows[it->second]);
+        // Rows sampled more than once are in the column more than once
+        std::unordered_map<RowPath, unsigned> sampledCounts;
+        for (auto & rowName: sampledRows)
+            ++sampledCounts[rowName];
+
+        std::vector<std::tuple<RowPath, CellValue, Date> > allRows
+            = std::move(col.rows);
+        col.rows.clear();
+        for (auto & r: allRows) {
+            auto it = sampledCounts.find(get<0>(r));
+            if (it == sampledCounts.end())
+                continue;
+            for (unsigned i = 0;  i < it->second;  ++i)
+                col.rows.emplace_back(r);
         }
 
         return col;
@@ -353,6 +467,13 @@ getColumnIndex() const
     return itl;
 }
 
+std::shared_ptr<RowStream>
+SampledDataset::
+getRowStream() const
+{
+    return std::make_shared<SampledDataset::Itl::SampledRowStream>(itl.get());
+}
+
 std::string
 SampledDataset::
 getErrorMsg(const std::string msg)
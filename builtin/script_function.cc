@@ -6,11 +6,15 @@
 */
 
 #include "script_function.h"
+#include "script_worker_pool.h"
 #include "mldb/core/mldb_engine.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/rest/in_process_rest_connection.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+#include <cstdlib>
 
 using namespace std;
 
@@ -20,6 +24,27 @@ namespace MLDB {
 
 
 
+/*****************************************************************************/
+/* SCRIPT EXECUTION                                                          */
+/*****************************************************************************/
+
+DEFINE_ENUM_DESCRIPTION(ScriptExecution);
+
+ScriptExecutionDescription::
+ScriptExecutionDescription()
+{
+    addValue("inProcess", SCRIPT_EXECUTION_IN_PROCESS,
+             "Run the script in a Python interpreter inside MLDB, with "
+             "access to the whole of the MLDB API.  Python calls run one "
+             "at a time, as they share the interpreter lock.");
+    addValue("workers", SCRIPT_EXECUTION_WORKERS,
+             "Run the script in a pool of separate Python processes, so that "
+             "calls run in parallel.  Only Python is supported, and the "
+             "script only has access to `mldb.script.args`, "
+             "`mldb.script.set_return()` and `mldb.log()`.");
+}
+
+
 /*****************************************************************************/
 /* SCRIPT FUNCTION CONFIG                                                    */
 /*****************************************************************************/
@@ -33,6 +58,16 @@ ScriptFunctionConfigDescription()
             "Script language (python or javascript)");
     addField("scriptConfig", &ScriptFunctionConfig::scriptConfig, 
             "Script resource configuration");
+    addField("execution", &ScriptFunctionConfig::execution,
+             "Where the script runs: in MLDB's own Python interpreter, or "
+             "in a pool of Python worker processes",
+             SCRIPT_EXECUTION_IN_PROCESS);
+    addField("numWorkers", &ScriptFunctionConfig::numWorkers,
+             "Maximum number of worker processes when execution is "
+             "`workers`.  The default of -1 means one per CPU.", -1);
+    addField("batchSize", &ScriptFunctionConfig::batchSize,
+             "Number of rows sent to a worker process at once when the "
+             "function is applied to a batch of rows", 64);
 }
 
 
@@ -62,6 +97,25 @@ ScriptFunction(MldbEngine * owner,
                         "ND", functionConfig.scriptConfig.toPluginConfig());
 
     cachedResource.source = loadedResource.getScript(PackageElement::MAIN);
+
+    if (functionConfig.execution == SCRIPT_EXECUTION_WORKERS) {
+        if (runner != "python") {
+            throw AnnotatedException(400, "Only Python script functions "
+                                     "can run in worker processes",
+                                     "language", functionConfig.language);
+        }
+        if (functionConfig.batchSize <= 0) {
+            throw AnnotatedException(400, "batchSize must be positive",
+                                     "batchSize", functionConfig.batchSize);
+        }
+
+        const char * executable = getenv("MLDB_PYTHON_EXECUTABLE");
+        int numWorkers = functionConfig.numWorkers > 0
+            ? functionConfig.numWorkers : numCpus();
+        workers = std::make_shared<ScriptWorkerPool>
+            (executable ? executable : "python3",
+             cachedResource.source, numWorkers);
+    }
 }
 
 Any
@@ -71,21 +125,54 @@ getStatus() const
     return Any();
 }
 
+namespace {
+
+/// Arguments passed to the script for the given function input
+Json::Value getScriptArgs(const ExpressionValue & context)
+{
+    ExpressionValue args = context.getColumn(PathElement("args"));
+    return jsonEncode(args);
+}
+
+/// Convert what the script returned into the function output
+ExpressionValue getScriptOutput(const Json::Value & result)
+{
+    vector<tuple<PathElement, ExpressionValue>> vals;
+    if(!result.isArray()) {
+        throw MLDB::Exception("Function should return array of arrays.");
+    }
+
+    for(const Json::Value & elem : result) {
+        if(!elem.isArray() || elem.size() != 3)
+            throw MLDB::Exception("elem should be array of size 3");
+
+        vals.push_back(make_tuple(PathElement(elem[0].asString()),
+                                  ExpressionValue(elem[1],
+                                                  Date::parseIso8601DateTime(elem[2].asString()))));
+    }
+
+    StructValue sresult;
+    sresult.emplace_back("return", std::move(vals));
+
+    return std::move(sresult);
+}
+
+} // file scope
+
 ExpressionValue
 ScriptFunction::
 apply(const FunctionApplier & applier,
       const ExpressionValue & context) const
 {
+    if (workers)
+        return getScriptOutput(workers->run({ getScriptArgs(context) })[0]);
+
     string resource = "/v1/types/plugins/" + runner + "/routes/run";
 
     // make it so that if the params parameter contains an args key, we move
     // its contents to the args parameter of the script
     ScriptResource copiedSR(cachedResource);
-
-    ExpressionValue args = context.getColumn(PathElement("args"));
-    //Json::Value val = { args.extractJson(), jsonEncode(args.getEffectiveTimestamp()) };
-    Json::Value val = jsonEncode(args);
-    copiedSR.args = val;
+    copiedSR.args = getScriptArgs(context);
 
     DEBUG_MSG(logger) << "script args = " << jsonEncode(copiedSR.args);
 
@@ -104,26 +191,40 @@ apply(const FunctionApplier & applier,
                                  Json::parse(connection->response()));
     }
 
-    Json::Value result = Json::parse(connection->response())["result"];
-    
-    vector<tuple<PathElement, ExpressionValue>> vals;
-    if(!result.isArray()) {
-        throw MLDB::Exception("Function should return array of arrays.");
-    }
-
-    for(const Json::Value & elem : result) {
-        if(!elem.isArray() || elem.size() != 3)
-            throw MLDB::Exception("elem should be array of size 3");
-
-        vals.push_back(make_tuple(PathElement(elem[0].asString()),
-                                  ExpressionValue(elem[1],
-                                                  Date::parseIso8601DateTime(elem[2].asString()))));
-    }
+    return getScriptOutput(Json::parse(connection->response())["result"]);
+}
 
-    StructValue sresult;
-    sresult.emplace_back("return", std::move(vals));
+std::vector<ExpressionValue>
+ScriptFunction::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    if (!workers)
+        return Function::applyBatch(applier, inputs);
+
+    // Each batch goes to a worker in one message, and the batches are run
+    // in parallel over the workers
+    size_t batchSize = functionConfig.batchSize;
+    size_t numBatches = (inputs.size() + batchSize - 1) / batchSize;
+    std::vector<ExpressionValue> result(inputs.size());
+
+    auto doBatch = [&] (size_t batch)
+        {
+            size_t begin = batch * batchSize;
+            size_t end = std::min(begin + batchSize, inputs.size());
+            std::vector<Json::Value> args;
+            args.reserve(end - begin);
+            for (size_t i = begin;  i < end;  ++i)
+                args.emplace_back(getScriptArgs(inputs[i]));
+
+            auto outputs = workers->run(args);
+            for (size_t i = begin;  i < end;  ++i)
+                result[i] = getScriptOutput(outputs[i - begin]);
+        };
+
+    parallelMap(0, numBatches, doBatch, workers->maxWorkers());
 
-    return std::move(sresult);
+    return result;
 }
 
 FunctionInfo
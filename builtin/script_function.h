@@ -15,6 +15,20 @@
 
 namespace MLDB {
 
+struct ScriptWorkerPool;
+
+
+/*****************************************************************************/
+/* SCRIPT EXECUTION                                                          */
+/*****************************************************************************/
+
+enum ScriptExecution {
+    SCRIPT_EXECUTION_IN_PROCESS,   ///< In a Python interpreter inside MLDB
+    SCRIPT_EXECUTION_WORKERS       ///< In a pool of Python worker processes
+};
+
+DECLARE_ENUM_DESCRIPTION(ScriptExecution);
+
 
 /*****************************************************************************/
 /* SCRIPT FUNCTION CONFIG                                                    */
@@ -23,6 +37,9 @@ namespace MLDB {
 struct ScriptFunctionConfig {
     std::string language;
     ScriptResource scriptConfig;
+    ScriptExecution execution = SCRIPT_EXECUTION_IN_PROCESS;
+    int numWorkers = -1;
+    int batchSize = 64;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ScriptFunctionConfig);
@@ -43,12 +60,19 @@ struct ScriptFunction: public Function {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const;
+
     virtual FunctionInfo getFunctionInfo() const;
 
     ScriptFunctionConfig functionConfig;
 
     std::string runner;
     ScriptResource cachedResource;
+
+    /// Workers running the script when execution is SCRIPT_EXECUTION_WORKERS
+    std::shared_ptr<ScriptWorkerPool> workers;
 };
 
 
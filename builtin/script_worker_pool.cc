@@ -0,0 +1,298 @@
+/** script_worker_pool.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Pool of Python worker processes for script functions.
+*/
+
+#include "script_worker_pool.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include <spawn.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+extern char ** environ;
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/** Program run by each worker.  The first line it reads holds the script;
+    each following line is a JSON array of arguments, to which it replies
+    with one line holding either the results or the error.  The script's
+    own output to stdout is sent to stderr so it can't get mixed up with
+    the replies.
+*/
+const char * workerDriver = R"PYTHON(
+import json, sys, traceback, types
+
+_requests = sys.stdin
+_replies = sys.stdout
+sys.stdout = sys.stderr
+
+class _Script(object):
+    args = None
+    result = None
+
+    def set_return(self, value, code=200):
+        self.result = value
+
+class _Mldb(object):
+    def __init__(self):
+        self.script = _Script()
+
+    def log(self, *args):
+        sys.stderr.write(' '.join(a if isinstance(a, str) else json.dumps(a)
+                                  for a in args) + '\n')
+        sys.stderr.flush()
+
+mldb = _Mldb()
+_module = types.ModuleType('mldb')
+_module.mldb = mldb
+sys.modules['mldb'] = _module
+
+_code = None
+_compileError = None
+try:
+    _code = compile(json.loads(_requests.readline())['source'],
+                    '<script.apply>', 'exec')
+except Exception as exc:
+    _compileError = {'error': str(exc), 'traceback': traceback.format_exc()}
+
+for _line in _requests:
+    _reply = _compileError
+    if _reply is None:
+        _results = []
+        try:
+            for _args in json.loads(_line):
+                mldb.script.args = _args
+                mldb.script.result = None
+                exec(_code, {'__name__': '__main__', 'mldb': mldb,
+                             'request': mldb.script})
+                _results.append(mldb.script.result)
+            _reply = {'results': _results}
+        except Exception as exc:
+            _reply = {'error': str(exc), 'traceback': traceback.format_exc()}
+    _replies.write(json.dumps(_reply) + '\n')
+    _replies.flush()
+)PYTHON";
+
+} // file scope
+
+
+/*****************************************************************************/
+/* WORKER                                                                    */
+/*****************************************************************************/
+
+struct ScriptWorkerPool::Worker {
+    Worker(const std::string & pythonExecutable, const Utf8String & source)
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+            throw AnnotatedException(500, "Couldn't create socket for Python "
+                                     "worker", "error", string(strerror(errno)));
+        fd = fds[0];
+
+        // The worker's end becomes its stdin and stdout; dup2 clears the
+        // close on exec flag for them
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], 0);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+
+        const char * argv[] = { pythonExecutable.c_str(), "-c", workerDriver,
+                                nullptr };
+        int res = posix_spawnp(&pid, pythonExecutable.c_str(), &actions,
+                               nullptr, const_cast<char **>(argv), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        ::close(fds[1]);
+
+        if (res != 0) {
+            ::close(fd);
+            throw AnnotatedException(500, "Couldn't start Python worker",
+                                     "executable", pythonExecutable,
+                                     "error", string(strerror(res)));
+        }
+
+        Json::Value init;
+        init["source"] = source.rawString();
+        try {
+            send(init);
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+
+    ~Worker()
+    {
+        stop();
+    }
+
+    void stop()
+    {
+        // Workers hold no state, so there is no need to wait for them to
+        // finish cleanly
+        ::close(fd);
+        ::kill(pid, SIGKILL);
+        ::waitpid(pid, nullptr, 0);
+    }
+
+    /// Send one request and wait for the reply
+    Json::Value call(const Json::Value & request)
+    {
+        send(request);
+
+        size_t end;
+        while ((end = buffer.find('\n')) == string::npos) {
+            char data[65536];
+            ssize_t res = ::recv(fd, data, sizeof(data), 0);
+            if (res == -1 && errno == EINTR)
+                continue;
+            if (res <= 0)
+                throw AnnotatedException(500, "Python worker exited while "
+                                         "running script", "pid", pid);
+            buffer.append(data, res);
+        }
+
+        Json::Value reply = Json::parse(buffer.substr(0, end));
+        buffer.erase(0, end + 1);
+        return reply;
+    }
+
+    void send(const Json::Value & message)
+    {
+        string line = message.toStringNoNewLine() + "\n";
+        const char * p = line.data();
+        size_t left = line.size();
+        while (left > 0) {
+            // MSG_NOSIGNAL so that a dead worker is an error, not a SIGPIPE
+            ssize_t res = ::send(fd, p, left, MSG_NOSIGNAL);
+            if (res == -1 && errno == EINTR)
+                continue;
+            if (res == -1)
+                throw AnnotatedException(500, "Couldn't send to Python worker",
+                                         "pid", pid,
+                                         "error", string(strerror(errno)));
+            p += res;
+            left -= res;
+        }
+    }
+
+    pid_t pid = -1;
+    int fd = -1;
+    std::string buffer;  ///< Received data not yet returned
+};
+
+
+/*****************************************************************************/
+/* SCRIPT WORKER POOL                                                        */
+/*****************************************************************************/
+
+ScriptWorkerPool::
+ScriptWorkerPool(std::string pythonExecutable,
+                 Utf8String source,
+                 int maxWorkers)
+    : pythonExecutable(std::move(pythonExecutable)),
+      source(std::move(source)),
+      maxWorkers_(maxWorkers),
+      numWorkers(0)
+{
+    ExcAssertGreater(maxWorkers, 0);
+}
+
+ScriptWorkerPool::
+~ScriptWorkerPool()
+{
+}
+
+std::vector<Json::Value>
+ScriptWorkerPool::
+run(const std::vector<Json::Value> & args)
+{
+    Json::Value request(Json::arrayValue);
+    for (auto & a: args)
+        request.append(a);
+
+    std::unique_ptr<Worker> worker = acquire();
+    Json::Value reply;
+    try {
+        reply = worker->call(request);
+    } catch (...) {
+        discard(std::move(worker));
+        throw;
+    }
+    release(std::move(worker));
+
+    if (reply.isMember("error")) {
+        throw AnnotatedException(400, "Error running script in Python worker: "
+                                 + reply["error"].asString(),
+                                 "traceback", reply["traceback"]);
+    }
+
+    const Json::Value & results = reply["results"];
+    ExcAssertEqual(results.size(), args.size());
+    vector<Json::Value> result;
+    result.reserve(results.size());
+    for (auto & r: results)
+        result.push_back(r);
+    return result;
+}
+
+std::unique_ptr<ScriptWorkerPool::Worker>
+ScriptWorkerPool::
+acquire()
+{
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        workerFree.wait(guard, [&] () { return !idle.empty()
+                                        || numWorkers < maxWorkers_; });
+        if (!idle.empty()) {
+            auto result = std::move(idle.back());
+            idle.pop_back();
+            return result;
+        }
+        ++numWorkers;
+    }
+
+    // Start a new one outside of the lock, as it takes a while
+    try {
+        return std::make_unique<Worker>(pythonExecutable, source);
+    } catch (...) {
+        std::unique_lock<std::mutex> guard(mutex);
+        --numWorkers;
+        workerFree.notify_one();
+        throw;
+    }
+}
+
+void
+ScriptWorkerPool::
+release(std::unique_ptr<Worker> worker)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    idle.emplace_back(std::move(worker));
+    workerFree.notify_one();
+}
+
+void
+ScriptWorkerPool::
+discard(std::unique_ptr<Worker> worker)
+{
+    worker.reset();
+    std::unique_lock<std::mutex> guard(mutex);
+    --numWorkers;
+    workerFree.notify_one();
+}
+
+} // namespace MLDB
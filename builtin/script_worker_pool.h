@@ -0,0 +1,76 @@
+/** script_worker_pool.h                                            -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Pool of Python worker processes that run a script function outside of
+    the MLDB process, so that calls can use more than one core.
+*/
+
+#pragma once
+
+#include "mldb/ext/jsoncpp/value.h"
+#include "mldb/types/string.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SCRIPT WORKER POOL                                                        */
+/*****************************************************************************/
+
+/** Runs a Python script in a pool of separate Python processes, each of
+    which has its own interpreter and GIL.
+
+    Each worker compiles the script once and then runs it over batches of
+    arguments, which are exchanged as one line of JSON each way over a
+    socket connected to the worker's stdin and stdout.  Inside the worker,
+    the script sees a minimal mldb module: mldb.script.args holds the
+    arguments, mldb.script.set_return() (or request.set_return()) sets the
+    result and mldb.log() writes to MLDB's stderr.  The rest of the MLDB
+    API isn't available.
+
+    Workers are started when first needed, up to maxWorkers of them, and
+    are kept for the lifetime of the pool.  A worker that fails to answer
+    (for example because it crashed) is replaced by a new one.
+*/
+struct ScriptWorkerPool {
+    ScriptWorkerPool(std::string pythonExecutable,
+                     Utf8String source,
+                     int maxWorkers);
+    ~ScriptWorkerPool();
+
+    ScriptWorkerPool(const ScriptWorkerPool &) = delete;
+    void operator = (const ScriptWorkerPool &) = delete;
+
+    /** Run the script once for each of the given arguments in a single
+        worker, returning what each run passed to set_return() (or null
+        if nothing).  Blocks until a worker is free.  An error in the
+        script throws an exception holding its Python traceback.
+    */
+    std::vector<Json::Value> run(const std::vector<Json::Value> & args);
+
+    /// Maximum number of workers that may run at once
+    int maxWorkers() const { return maxWorkers_; }
+
+private:
+    struct Worker;
+
+    std::unique_ptr<Worker> acquire();
+    void release(std::unique_ptr<Worker> worker);
+    void discard(std::unique_ptr<Worker> worker);
+
+    std::string pythonExecutable;
+    Utf8String source;
+    int maxWorkers_;
+
+    std::mutex mutex;
+    std::condition_variable workerFree;
+    std::vector<std::unique_ptr<Worker> > idle;
+    int numWorkers;  ///< Started and not discarded, whether busy or idle
+};
+
+} // namespace MLDB
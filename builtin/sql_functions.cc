@@ -48,8 +48,113 @@ filterEmptyColumns(MatrixNamedRow & row) {
     }
     return cols;
 }
+
+/** Apply the function to each of the inputs in parallel, for functions
+    whose bound form may be run from many threads at once, as bound SQL
+    can.  The inputs are split into chunks so that small batches don't pay
+    for scheduling a job per input.
+*/
+std::vector<ExpressionValue>
+applyInParallel(const Function & function,
+                const FunctionApplier & applier,
+                const std::vector<ExpressionValue> & inputs)
+{
+    std::vector<ExpressionValue> result(inputs.size());
+
+    auto doChunk = [&] (size_t begin, size_t end)
+        {
+            for (size_t i = begin;  i < end;  ++i)
+                result[i] = function.apply(applier, inputs[i]);
+        };
+
+    parallelMapChunked(0, inputs.size(), 64 /* chunk size */, doChunk);
+
+    return result;
 }
 
+
+/*****************************************************************************/
+/* TRANSFORM OUTPUT RECORDER                                                 */
+/*****************************************************************************/
+
+/** Records the output rows of a transform into chunks of the output
+    dataset, obtained from its chunk recorder.  Each thread records into a
+    chunk of its own, which is finished once it holds rowsPerChunk rows;
+    datasets that freeze or commit a chunk when it's finished (tabular,
+    sparse.mutable) therefore do so while the query is still producing
+    rows, rather than all at once at the end.
+*/
+struct TransformOutputRecorder {
+    TransformOutputRecorder(Dataset & output)
+        : recorder(output.getChunkRecorder()),
+          chunkNumber(0)
+    {
+    }
+
+    /// Rows recorded into a chunk before it is finished and a new one started
+    static constexpr size_t rowsPerChunk = 65536;
+
+    void recordRowExpr(RowPath rowName, ExpressionValue row)
+    {
+        ThreadChunk & chunk = getChunk();
+        chunk.recorder->recordRowExprDestructive(std::move(rowName),
+                                                 std::move(row));
+        finishedRow(chunk);
+    }
+
+    void recordRow(RowPath rowName,
+                   std::vector<std::tuple<ColumnPath, CellValue, Date> > cols)
+    {
+        ThreadChunk & chunk = getChunk();
+        chunk.recorder->recordRowDestructive(std::move(rowName),
+                                             std::move(cols));
+        finishedRow(chunk);
+    }
+
+    /// Finish the chunks still open and commit them all to the dataset
+    void commit()
+    {
+        parallelMap(0, threads.threads.size(),
+                    [&] (size_t n)
+                    {
+                        auto & chunk = *threads.threads[n];
+                        if (chunk.recorder)
+                            chunk.recorder->finishedChunk();
+                    });
+        recorder.commit();
+    }
+
+private:
+    struct ThreadChunk {
+        std::unique_ptr<Recorder> recorder;
+        size_t numRows = 0;
+    };
+
+    ThreadChunk & getChunk()
+    {
+        ThreadChunk & chunk = threads.get();
+        if (!chunk.recorder) {
+            chunk.recorder = recorder.newChunk(chunkNumber.fetch_add(1));
+            chunk.numRows = 0;
+        }
+        return chunk;
+    }
+
+    void finishedRow(ThreadChunk & chunk)
+    {
+        if (++chunk.numRows < rowsPerChunk)
+            return;
+        chunk.recorder->finishedChunk();
+        chunk.recorder.reset();
+    }
+
+    Dataset::MultiChunkRecorder recorder;
+    PerThreadAccumulator<ThreadChunk> threads;
+    std::atomic<size_t> chunkNumber;
+};
+
+} // file scope
+
 std::shared_ptr<PipelineElement>
 getMldbRoot(MldbEngine * engine)
 {
@@ -110,14 +215,18 @@ getStatus() const
     result["expression"]["query"]["surface"] = functionConfig.query.stm->surface;
     result["expression"]["query"]["ast"] = functionConfig.query.stm->print();
     result["info"] = jsonEncode(getFunctionInfo());
+    {
+        std::unique_lock<std::mutex> guard(boundQueryMutex);
+        result["boundQueryCache"]["hits"] = boundQueryHits;
+        result["boundQueryCache"]["misses"] = boundQueryMisses;
+    }
     return result;
 }
 
-/** Structure that does all the work of the SQL expression function. */
-struct SqlQueryFunctionApplier: public FunctionApplier {
-    SqlQueryFunctionApplier(const SqlQueryFunction * function,
-                            const SqlQueryFunctionConfig & config)
-        : FunctionApplier(function), function(function)
+struct SqlQueryFunction::BoundQuery {
+    BoundQuery(const SqlQueryFunction * function,
+               const SqlQueryFunctionConfig & config)
+        : generation(function->engine->getCatalogGeneration())
     {
         std::set<Utf8String> inputParams;
 
@@ -145,7 +254,7 @@ struct SqlQueryFunctionApplier: public FunctionApplier {
                                                            SCHEMA_CLOSED));
         
 
-        switch (function->functionConfig.output) {
+        switch (config.output) {
         case FIRST_ROW:
             // What type does the pipeline return?
             this->info.output = ExpressionValueInfo::toRow
@@ -163,6 +272,46 @@ struct SqlQueryFunctionApplier: public FunctionApplier {
         }
     }
 
+    /// Catalog generation at which the query was bound
+    uint64_t generation;
+    std::shared_ptr<PipelineElement> pipeline;
+    std::shared_ptr<BoundPipelineElement> boundPipeline;
+    FunctionInfo info;
+};
+
+std::shared_ptr<const SqlQueryFunction::BoundQuery>
+SqlQueryFunction::
+getBoundQuery() const
+{
+    uint64_t generation = engine->getCatalogGeneration();
+    {
+        std::unique_lock<std::mutex> guard(boundQueryMutex);
+        if (boundQuery && boundQuery->generation == generation) {
+            ++boundQueryHits;
+            return boundQuery;
+        }
+        ++boundQueryMisses;
+    }
+
+    // Bind outside of the lock, as it may need to wait for datasets.  If
+    // two threads get here at once, they both bind and the last one wins.
+    auto result = std::make_shared<const BoundQuery>(this, functionConfig);
+
+    std::unique_lock<std::mutex> guard(boundQueryMutex);
+    boundQuery = result;
+    return result;
+}
+
+/** Structure that does all the work of the SQL expression function. */
+struct SqlQueryFunctionApplier: public FunctionApplier {
+    SqlQueryFunctionApplier(const SqlQueryFunction * function)
+        : FunctionApplier(function), function(function),
+          query(function->getBoundQuery()),
+          boundPipeline(query->boundPipeline)
+    {
+        this->info = query->info;
+    }
+
     virtual ~SqlQueryFunctionApplier()
     {
     }
@@ -278,8 +427,7 @@ struct SqlQueryFunctionApplier: public FunctionApplier {
     }
 
     const SqlQueryFunction * function;
-    std::shared_ptr<Dataset> from;
-    std::shared_ptr<PipelineElement> pipeline;
+    std::shared_ptr<const SqlQueryFunction::BoundQuery> query;
     std::shared_ptr<BoundPipelineElement> boundPipeline;
 };
 
@@ -289,7 +437,7 @@ bind(SqlBindingScope & outerContext,
      const std::vector<std::shared_ptr<ExpressionValueInfo> > & input) const
 {
     std::unique_ptr<SqlQueryFunctionApplier> result
-        (new SqlQueryFunctionApplier(this, functionConfig));
+        (new SqlQueryFunctionApplier(this));
 
     result->info.checkInputCompatibility(input);
 
@@ -305,12 +453,19 @@ apply(const FunctionApplier & applier,
         .apply(context);
 }
 
+std::vector<ExpressionValue>
+SqlQueryFunction::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    return applyInParallel(*this, applier, inputs);
+}
+
 FunctionInfo
 SqlQueryFunction::
 getFunctionInfo() const
 {
-    SqlQueryFunctionApplier applier(this, functionConfig);
-    return applier.info;
+    return getBoundQuery()->info;
 }
 
 static RegisterFunctionType<SqlQueryFunction, SqlQueryFunctionConfig>
@@ -572,6 +727,14 @@ apply(const FunctionApplier & applier,
            .apply(context);
 }
 
+std::vector<ExpressionValue>
+SqlExpressionFunction::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    return applyInParallel(*this, applier, inputs);
+}
+
 FunctionInfo
 SqlExpressionFunction::
 getFunctionInfo() const
@@ -580,6 +743,13 @@ getFunctionInfo() const
         return this->info;
     }
 
+    uint64_t generation = engine->getCatalogGeneration();
+    {
+        std::unique_lock<std::mutex> guard(unpreparedInfoMutex);
+        if (unpreparedInfo && unpreparedInfoGeneration == generation)
+            return *unpreparedInfo;
+    }
+
     FunctionInfo result;
 
     // 1.  Create a binding context to see what this function takes
@@ -606,6 +776,10 @@ getFunctionInfo() const
     else {
         result.input.emplace_back(outerScope.inputInfo);
     }
+
+    std::unique_lock<std::mutex> guard(unpreparedInfoMutex);
+    unpreparedInfo = std::make_shared<const FunctionInfo>(result);
+    unpreparedInfoGeneration = generation;
     
     return result;
 }
@@ -623,7 +797,7 @@ regSqlExpressionFunction(builtinPackage(),
 
 TransformDatasetConfig::
 TransformDatasetConfig()
-    : skipEmptyRows(false)
+    : skipEmptyRows(false), preserveRowOrder(false)
 {
     outputDataset.withType("sparse.mutable");
 }
@@ -645,6 +819,16 @@ TransformDatasetConfigDescription()
     addField("skipEmptyRows", &TransformDatasetConfig::skipEmptyRows,
              "Skip rows from the input dataset where no values are selected",
              false);
+    addField("preserveRowOrder", &TransformDatasetConfig::preserveRowOrder,
+             "Record the output rows from a single thread, in the order in "
+             "which the query produces them.  By default rows are "
+             "transformed and recorded by several threads at once, and so "
+             "arrive at the output dataset in no particular order.  Only "
+             "useful for output datasets that keep rows in the order in "
+             "which they were recorded.  This has no effect on queries "
+             "with a GROUP BY clause or aggregators, whose rows are always "
+             "recorded in order.",
+             false);
     addParent<ProcedureConfig>();
 }
 
@@ -688,12 +872,14 @@ run(const ProcedureRunConfig & run,
         createDataset(engine, runProcConf.outputDataset, nullptr, true /*overwrite*/);
     bool skipEmptyRows = runProcConf.skipEmptyRows;
 
-    auto recordRowInOutputDataset = [&output, &skipEmptyRows] (MatrixNamedRow & row) {
+    TransformOutputRecorder outputRecorder(*output);
+
+    auto recordRowInOutputDataset = [&] (MatrixNamedRow & row) {
         std::vector<std::tuple<ColumnPath, CellValue, Date> > cols
             = filterEmptyColumns(row);
 
         if (!skipEmptyRows || cols.size() > 0)
-            output->recordRow(row.rowName, cols);
+            outputRecorder.recordRow(std::move(row.rowName), std::move(cols));
 
         return true;
         };
@@ -703,7 +889,7 @@ run(const ProcedureRunConfig & run,
         // query without dataset
         std::vector<MatrixNamedRow> rows = queryWithoutDataset(*runProcConf.inputData.stm, context);
         std::for_each(rows.begin(), rows.end(), recordRowInOutputDataset);
-        output->commit();
+        outputRecorder.commit();
         return output->getStatus();
     }
 
@@ -737,10 +923,11 @@ run(const ProcedureRunConfig & run,
         ExcAssert(boundDataset.table);
 
         std::function<bool (Path &, ExpressionValue &)> rowAccumulator = 
-            [=] (Path & rowName, ExpressionValue &rowValue) -> bool { 
+            [&] (Path & rowName, ExpressionValue &rowValue) -> bool { 
 
              if (!skipEmptyRows || rowValue.rowLength() > 0)
-                output->recordRowExpr(rowName, rowValue);
+                 outputRecorder.recordRowExpr(std::move(rowName),
+                                              std::move(rowValue));
 
              return true;
         };
@@ -754,37 +941,11 @@ run(const ProcedureRunConfig & run,
                            onTransformingProgress);
     }
     else if (runProcConf.inputData.stm->groupBy.clauses.empty() && aggregators.empty()) {
-        Dataset::MultiChunkRecorder recorder
-            = output->getChunkRecorder();
-
-        struct ThreadAccum {
-            /// Recorder object for this thread that the dataset gives us
-            /// to record into the dataset.
-            std::unique_ptr<Recorder> threadRecorder;
-
-            /// Special function to allow rapid insertion of fixed set of
-            /// atom valued columns.  Only for isIdentitySelect.
-            //std::function<void (RowPath rowName,
-            //                    Date timestamp,
-            //                    CellValue * vals,
-            //                    size_t numVals,
-            //                    std::vector<std::pair<ColumnPath, CellValue> > extra)>
-            //specializedRecorder;
-
-        };
-
-        PerThreadAccumulator<ThreadAccum> accum;
-
-        std::atomic<size_t> chunkNumber(0);
         auto recordRowInOutputDataset
             = [&] (RowPath & rowPath,
                    ExpressionValue & row,
                    std::vector<ExpressionValue> & calc)
             {
-                auto & threadAccum = accum.get();
-                if (!threadAccum.threadRecorder) {
-                    threadAccum.threadRecorder = recorder.newChunk(chunkNumber.fetch_add(1));
-                }
                 if (skipEmptyRows) {
                     if (row.empty())
                         return true;
@@ -808,12 +969,17 @@ run(const ProcedureRunConfig & run,
                 }
                 // TODO: could optimize slightly by finding rowName == rowName()
                 // and copying the existing rowPath in that case
-                threadAccum.threadRecorder->recordRowExprDestructive
-                    (calc[0].coerceToPath(), std::move(row));
+                outputRecorder.recordRowExpr(calc[0].coerceToPath(),
+                                             std::move(row));
                 return true;
             };
 
-        DEBUG_MSG(logger) << "performing dataset transform";
+        // Rows are only recorded in the order the query produces them
+        // when asked to, as that means recording from a single thread
+        bool processInParallel = !runProcConf.preserveRowOrder;
+
+        DEBUG_MSG(logger) << "performing dataset transform"
+                          << (processInParallel ? "" : " preserving row order");
    
         ConvertProgressToJson convertProgressToJson(onProgress);
         if (!BoundSelectQuery(runProcConf.inputData.stm->select,
@@ -823,7 +989,7 @@ run(const ProcedureRunConfig & run,
                               *runProcConf.inputData.stm->where,
                               runProcConf.inputData.stm->orderBy,
                               { runProcConf.inputData.stm->rowName })
-            .executeExpr({recordRowInOutputDataset, true /*processInParallel*/},
+            .executeExpr({recordRowInOutputDataset, processInParallel},
                          runProcConf.inputData.stm->offset,
                          runProcConf.inputData.stm->limit,
                          onTransformingProgress) )
@@ -833,15 +999,6 @@ run(const ProcedureRunConfig & run,
                                                 " procedure was cancelled");
                 
             }
-
-        // Finish off the last bits of each thread
-        parallelMap(0, accum.threads.size(),
-                    [&] (size_t n)
-                    {
-                        auto & threadAccum = *accum.threads[n];
-                        ExcAssert(threadAccum.threadRecorder.get());
-                        threadAccum.threadRecorder->finishedChunk();
-                    });
     }
     else {
         auto recordRowInOutputDataset
@@ -851,7 +1008,8 @@ run(const ProcedureRunConfig & run,
                 std::vector<std::tuple<ColumnPath, CellValue, Date> > cols
                     = filterEmptyColumns(row);
                 if (!skipEmptyRows || cols.size() > 0)
-                    output->recordRow(row.rowName, cols);
+                    outputRecorder.recordRow(std::move(row.rowName),
+                                             std::move(cols));
 
                 return true;
             };
@@ -883,8 +1041,8 @@ run(const ProcedureRunConfig & run,
             }
     }
 
-    // Save the dataset we created
-    output->commit();
+    // Finish off the chunks and save the dataset we created
+    outputRecorder.commit();
 
     return output->getStatus();
 }
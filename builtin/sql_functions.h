@@ -13,6 +13,7 @@
 #include "mldb/core/function.h"
 #include "mldb/core/dataset.h"
 #include "mldb/sql/sql_expression.h"
+#include <mutex>
 
 
 namespace MLDB {
@@ -60,9 +61,27 @@ struct SqlQueryFunction: public Function {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    /** Run the query for each of the inputs in parallel. */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const override;
+
     virtual FunctionInfo getFunctionInfo() const;
 
     SqlQueryFunctionConfig functionConfig;
+
+    /** The query bound to its datasets.  This is shared between all of
+        the appliers of the function, and is bound again only when a dataset
+        or function has changed since it was bound.
+    */
+    struct BoundQuery;
+    std::shared_ptr<const BoundQuery> getBoundQuery() const;
+
+private:
+    mutable std::mutex boundQueryMutex;
+    mutable std::shared_ptr<const BoundQuery> boundQuery;
+    mutable uint64_t boundQueryHits = 0;
+    mutable uint64_t boundQueryMisses = 0;
 };
 
 
@@ -97,6 +116,16 @@ struct SqlExpressionFunction: public Function {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    /** Evaluate the bound expression for each of the inputs in parallel. */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const override;
+
+    /** Return the input and output of the function.  When it's not
+        prepared, this requires binding the expression, so the result is
+        kept until a dataset or function changes, as that may change what
+        the expression binds to.
+    */
     virtual FunctionInfo getFunctionInfo() const;
 
     SqlExpressionFunctionConfig functionConfig;
@@ -111,6 +140,11 @@ struct SqlExpressionFunction: public Function {
 
     std::tuple<PathElement, std::vector<std::shared_ptr<ExpressionValueInfo> > >
     getAutoInputName(SqlExpressionExtractScope & innerScope) const;
+
+private:
+    mutable std::mutex unpreparedInfoMutex;
+    mutable std::shared_ptr<const FunctionInfo> unpreparedInfo;
+    mutable uint64_t unpreparedInfoGeneration = 0;
 };
 
 
@@ -135,6 +169,9 @@ struct TransformDatasetConfig : ProcedureConfig {
 
     /// Skip rows with no columns
     bool skipEmptyRows;
+
+    /// Record the rows from a single thread, in the order of the query
+    bool preserveRowOrder;
 };
 
 
@@ -10,7 +10,7 @@
 #include "mldb/engine/analytics.h"
 #include "sub_dataset.h"
 #include "mldb/types/any_impl.h"
-#include "mldb/utils/lightweight_hash.h"
+#include "mldb/utils/swiss_hash.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/annotated_exception.h"
 #include <unordered_set>
@@ -50,7 +50,7 @@ struct SubDataset::Itl
         std::vector<NamedRowValue> subOutput;
         std::set<PathElement> columnNames;
         std::set<ColumnPath> fullFlattenedColumnNames;
-        LightweightHash<RowHash, int64_t> rowIndex;
+        SwissHash<RowHash, int64_t> rowIndex;
         Date earliest, latest;
         std::shared_ptr<ExpressionValueInfo> columnInfo;
     };
@@ -23,6 +23,9 @@
 #include "mldb/utils/log.h"
 #include "mldb/utils/progress.h"
 #include <memory>
+#include <map>
+#include <unordered_map>
+#include <cmath>
 
 
 using namespace std;
@@ -140,286 +143,134 @@ struct MostFrequents {
     }
 };
 
-// Simple handlers to enhance the lisibility of the run function.
-struct NumericRowHandler {
-    NumericRowHandler() = delete;
-    NumericRowHandler(BoundTableExpression & boundDataset,
-                      SummaryStatisticsProcedureConfig & config,
-                      shared_ptr<Dataset> output,
-                      Date now,
-                      const std::function<bool (const Json::Value &)> & onProgress)
-        : first(true), boundDataset(boundDataset), config(config),
-          output(output), now(now), onProgress(onProgress) {}
-
-    const int AVG_IDX = 0;
-    const int MAX_IDX = 1;
-    const int MIN_IDX = 2;
-    const int NUM_NOT_NULL_IDX = 3;
-    const int NUM_NULL_IDX = 4;
-    const int NUM_UNIQUE_IDX = 5;
-    const int STDDEV_IDX = 6;
-
-    bool first;
-    BoundTableExpression & boundDataset;
-    SummaryStatisticsProcedureConfig & config;
-    shared_ptr<Dataset> output;
-    Date now;
-    std::function<bool (const Json::Value &)> onProgress;
-
-    // Returns false if the column failed to be treated as numeric
-    bool recordStatsForColumn(const Utf8String & name, const Path & rowName) {
-
-        int64_t numNotNull = 0;
-        bool isNumeric = false;
-        ColumnPath value("value");
-        auto onRow = [&] (NamedRowValue & row) {
-
-            // If the data is categorical, we don't even reach this point
-
-            const auto & cols = row.columns;
-            if (MLDB_UNLIKELY(first)) {
-                // Checks on the first row if the expected order is correct
-                ExcAssert(std::get<0>(cols[AVG_IDX]).toUtf8String() == "avg");
-                ExcAssert(std::get<0>(cols[MAX_IDX]).toUtf8String() == "max");
-                ExcAssert(std::get<0>(cols[MIN_IDX]).toUtf8String() == "min");
-                ExcAssert(std::get<0>(cols[NUM_NOT_NULL_IDX]).toUtf8String() == "num_not_null");
-                ExcAssert(std::get<0>(cols[NUM_NULL_IDX]).toUtf8String() == "num_null");
-                ExcAssert(std::get<0>(cols[NUM_UNIQUE_IDX]).toUtf8String() == "num_unique");
-                ExcAssert(std::get<0>(cols[STDDEV_IDX]).toUtf8String() == "stddev");
+/** Values seen for one column, by one thread or (once merged) overall.
+    Keeping a count for each distinct value gives exact statistics,
+    including the quartiles and most frequent values, from a single pass
+    over the data.
+*/
+struct ColumnValueCounts {
+    std::unordered_map<CellValue, int64_t> counts;
+    int64_t numNotNull = 0;
+    bool allNumeric = true;
+
+    void add(const CellValue & val)
+    {
+        if (val.empty())
+            return;
+        ++numNotNull;
+        if (!val.isNumber())
+            allNumeric = false;
+        ++counts[val];
+    }
 
-            }
+    void merge(ColumnValueCounts & other)
+    {
+        if (counts.size() < other.counts.size())
+            counts.swap(other.counts);
+        for (auto & c: other.counts)
+            counts[c.first] += c.second;
+        other.counts.clear();
+        numNotNull += other.numNotNull;
+        allNumeric = allNumeric && other.allNumeric;
+    }
+};
 
-            vector<Cell> toRecord;
-            if (!std::get<1>(cols[MAX_IDX]).isNumber()) {
-                // If the column is empty, we reach this point (max is null)
-                auto theThing = std::get<1>(cols[MAX_IDX]);
-                return false;
-            }
-            isNumeric = true;
-            toRecord.emplace_back(value + "avg", std::get<1>(cols[AVG_IDX]).toDouble(), now);
-            toRecord.emplace_back(value + "max", std::get<1>(cols[MAX_IDX]).toDouble(), now);
-            toRecord.emplace_back(value + "min", std::get<1>(cols[MIN_IDX]).toDouble(), now);
-            toRecord.emplace_back(value + "num_null", std::get<1>(cols[NUM_NULL_IDX]).toInt(), now);
-            toRecord.emplace_back(value + "num_unique", std::get<1>(cols[NUM_UNIQUE_IDX]).toInt(), now);
-            toRecord.emplace_back(value + "stddev", std::get<1>(cols[STDDEV_IDX]).toDouble(), now);
-            toRecord.emplace_back(value + "data_type", "number", now);
-            output->recordRow(rowName, toRecord);
-            numNotNull = std::get<1>(cols[NUM_NOT_NULL_IDX]).toInt();
+/** What each thread accumulates while scanning the input. */
+struct SummaryStatisticsThreadAccum {
+    SummaryStatisticsThreadAccum(size_t numColumns)
+        : columns(numColumns), lastRowSeen(numColumns, -1)
+    {
+    }
 
-            return true;
-        };
+    int64_t numRows = 0;
+    std::vector<ColumnValueCounts> columns;
 
-        auto select = SelectExpression::parse(
-            "count_distinct(" + name + ") AS num_unique, "
-            "min(" + name + ") AS min, "
-            "max(" + name + ") AS max, "
-            "avg(" + name + ") AS avg, "
-            "sum(" + name + " IS NULL) AS num_null, "
-            "sum(" + name + " IS NOT NULL) AS num_not_null, "
-            "stddev(" + name + ") AS stddev"
-        );
-        vector<shared_ptr<SqlExpression>> aggregators =
-            select.findAggregators(!config.inputData.stm->groupBy.clauses.empty());
-
-        try {
-            // The first query is used to determine whether it's numeric or
-            // not, hence the special try/catch/failedProcessingQuery handling.
-            ConvertProgressToJson convertProgressToJson(onProgress);
-            BoundGroupByQuery(select,
-                              *boundDataset.dataset,
-                              boundDataset.asName,
-                              config.inputData.stm->when,
-                              *config.inputData.stm->where,
-                              config.inputData.stm->groupBy,
-                              aggregators,
-                              *config.inputData.stm->having,
-                              *config.inputData.stm->rowName,
-                              config.inputData.stm->orderBy)
-                .execute({onRow, false /*processInParallel*/},
-                         0, // offset
-                         -1, // limit
-                         convertProgressToJson);
-        }
-        catch (const MLDB::Exception & exc) {
-            if (!isNumeric) {
-                // Categorical, the query doesn't work
-                return false;
-            }
-            throw;
-        }
-        if (!isNumeric) {
-            // empty col
-            return false;
-        }
+    /// Last row each column was seen in, to count a column once per row
+    std::vector<int64_t> lastRowSeen;
+};
 
-        select = SelectExpression::parse("count(" + name + ") AS _0, "
-                                         + name + " AS _1");
-        auto groupBy = TupleExpression::parse(name);
-        auto orderBy = OrderByExpression::parse(name);
-        auto where = SqlExpression::parse(name + " IS NOT NULL");
-        const int NUM_QUARTILES = 3;
-        double quartiles[NUM_QUARTILES];
-        double quartilesThreshold[NUM_QUARTILES] = {numNotNull * 0.25,
-                                                    numNotNull * 0.5,
-                                                    numNotNull * 0.75};
-        int idx = 0;
-        int64_t count = 0;
-        MostFrequents<double, 10> mostFrequents; // Keep top 10
-        auto onRow2 = [&] (NamedRowValue & row) {
-            const auto & cols = row.columns;
-            if (MLDB_UNLIKELY(first)) {
-                ExcAssert(std::get<0>(cols[0]).toUtf8String() == "_0");
-                ExcAssert(std::get<0>(cols[1]).toUtf8String() == "_1");
-                first = false;
-            }
-            int64_t currentCount = std::get<1>(cols[0]).toInt();
-            mostFrequents.addItem(make_pair(currentCount,
-                                            std::get<1>(cols[1]).toDouble()));
-            count += currentCount;
-            while (idx < NUM_QUARTILES && quartilesThreshold[idx] < count) {
-                quartiles[idx] = std::get<1>(cols[1]).toDouble();
-                ++idx;
-            }
-            return true;
-        };
-        ConvertProgressToJson convertProgressToJson(onProgress);
-        BoundGroupByQuery(select,
-                        *boundDataset.dataset,
-                        boundDataset.asName,
-                        config.inputData.stm->when,
-                        *where,
-                        groupBy,
-                        aggregators,
-                        *config.inputData.stm->having,
-                        *config.inputData.stm->rowName,
-                        orderBy)
-            .execute({onRow2, false /*processInParallel*/},
-                     0, // offset
-                     -1, // limit
-                     convertProgressToJson);
-        ExcAssert(count == numNotNull);
-        ExcAssert(idx == NUM_QUARTILES);
-        vector<Cell> toRecord;
-        toRecord.emplace_back(value + "1st_quartile", quartiles[0], now);
-        toRecord.emplace_back(value + "median", quartiles[1], now);
-        toRecord.emplace_back(value + "3rd_quartile", quartiles[2], now);
-        for (int i = 0; i < mostFrequents.currSize; ++ i) {
-            toRecord.emplace_back(
-                // CellValue::to_string returns "1" instead of "1.00000"
-                value + "most_frequent_items" + to_string(CellValue(mostFrequents.top[i].second)),
-                mostFrequents.top[i].first, now);
+/** Statistics of a column whose values are all numbers. */
+vector<Cell>
+getNumericStats(const ColumnValueCounts & column, int64_t numRows, Date now)
+{
+    ColumnPath value("value");
+
+    std::map<double, int64_t> sorted;
+    for (auto & c: column.counts)
+        sorted[c.first.toDouble()] += c.second;
+
+    int64_t n = column.numNotNull;
+    double sum = 0;
+    for (auto & v: sorted)
+        sum += v.first * v.second;
+    double mean = sum / n;
+    double M2 = 0;
+    for (auto & v: sorted)
+        M2 += v.second * (v.first - mean) * (v.first - mean);
+    double stddev = n < 2 ? std::nan("") : sqrt(M2 / (n - 1));
+
+    const int NUM_QUARTILES = 3;
+    double quartiles[NUM_QUARTILES];
+    double quartilesThreshold[NUM_QUARTILES] = {n * 0.25, n * 0.5, n * 0.75};
+    int idx = 0;
+    int64_t count = 0;
+    MostFrequents<double, 10> mostFrequents; // Keep top 10
+    for (auto & v: sorted) {
+        mostFrequents.addItem(make_pair(v.second, v.first));
+        count += v.second;
+        while (idx < NUM_QUARTILES && quartilesThreshold[idx] < count) {
+            quartiles[idx] = v.first;
+            ++idx;
         }
-        output->recordRow(rowName, toRecord);
-        return true;
     }
+    ExcAssert(count == n);
+    ExcAssert(idx == NUM_QUARTILES);
+
+    vector<Cell> result;
+    result.emplace_back(value + "avg", mean, now);
+    result.emplace_back(value + "max", sorted.rbegin()->first, now);
+    result.emplace_back(value + "min", sorted.begin()->first, now);
+    result.emplace_back(value + "num_null", numRows - n, now);
+    result.emplace_back(value + "num_unique", (int64_t)column.counts.size(),
+                        now);
+    result.emplace_back(value + "stddev", stddev, now);
+    result.emplace_back(value + "data_type", "number", now);
+    result.emplace_back(value + "1st_quartile", quartiles[0], now);
+    result.emplace_back(value + "median", quartiles[1], now);
+    result.emplace_back(value + "3rd_quartile", quartiles[2], now);
+    for (int i = 0; i < mostFrequents.currSize; ++ i) {
+        result.emplace_back(
+            // CellValue::to_string returns "1" instead of "1.00000"
+            value + "most_frequent_items" + to_string(CellValue(mostFrequents.top[i].second)),
+            mostFrequents.top[i].first, now);
+    }
+    return result;
+}
 
-};
-
-struct CategoricalRowHandler {
-    CategoricalRowHandler() = delete;
-    CategoricalRowHandler(BoundTableExpression & boundDataset,
-                          SummaryStatisticsProcedureConfig & config,
-                          shared_ptr<Dataset> output,
-                          Date now,
-                          const std::function<bool (const Json::Value &)> & onProgress)
-        : first(true), boundDataset(boundDataset), config(config),
-          output(output), now(now), onProgress(onProgress) {}
-
-    const int NUM_NULL_IDX = 0;
-    const int NUM_UNIQUE_IDX = 1;
-
-    bool first;
-    BoundTableExpression & boundDataset;
-    SummaryStatisticsProcedureConfig & config;
-    shared_ptr<Dataset> output;
-    Date now;
-    std::function<bool (const Json::Value &)> onProgress;
-
-    void recordStatsForColumn(const Utf8String & name, const Path & rowName) {
-        ColumnPath value("value");
-        auto onRow = [&] (NamedRowValue & row) {
-            const auto & cols = row.columns;
-            if (MLDB_UNLIKELY(first)) {
-                // Checks on the first row if the expected order is correct
-                ExcAssert(std::get<0>(cols[NUM_NULL_IDX]).toUtf8String() == "num_null");
-                ExcAssert(std::get<0>(cols[NUM_UNIQUE_IDX]).toUtf8String() == "num_unique");
-            }
-            vector<Cell> toRecord;
-            toRecord.emplace_back(value + "data_type", "categorical", now);
-            toRecord.emplace_back(value + "num_null", std::get<1>(cols[NUM_NULL_IDX]).toInt(), now);
-            toRecord.emplace_back(value + "num_unique", std::get<1>(cols[NUM_UNIQUE_IDX]).toInt(), now);
-            output->recordRow(rowName, toRecord);
-            return true;
-        };
-
-        auto select = SelectExpression::parse(
-            "count_distinct(" + name + ") AS num_unique, "
-            "sum(" + name + " IS NULL) AS num_null"
-        );
-        vector<shared_ptr<SqlExpression>> aggregators =
-            select.findAggregators(!config.inputData.stm->groupBy.clauses.empty());
-
-        ConvertProgressToJson convertProgressToJson(onProgress);
-        BoundGroupByQuery(select,
-                        *boundDataset.dataset,
-                        boundDataset.asName,
-                        config.inputData.stm->when,
-                        *config.inputData.stm->where,
-                        config.inputData.stm->groupBy,
-                        aggregators,
-                        *config.inputData.stm->having,
-                        *config.inputData.stm->rowName,
-                        config.inputData.stm->orderBy)
-            .execute({onRow, false /*processInParallel*/},
-                     0, // offset
-                     -1, // limit
-                    convertProgressToJson);
-
-        select = SelectExpression::parse("count(" + name + ") AS _0, "
-                                         + name + " AS _1");
-        auto groupBy = TupleExpression::parse(name);
-        auto orderBy = OrderByExpression::parse("_0 DESC");
-
-        MostFrequents<Utf8String, 10> mostFrequents; // Keep top 10
-        auto onRow2 = [&] (NamedRowValue & row) {
-            const auto & cols = row.columns;
-            if (MLDB_UNLIKELY(first)) {
-                ExcAssert(std::get<0>(cols[0]).toUtf8String() == "_0");
-                ExcAssert(std::get<0>(cols[1]).toUtf8String() == "_1");
-            }
-            if (MLDB_UNLIKELY(std::get<1>(cols[1]).empty())) {
-                // skipp null
-                return true;
-            }
-            mostFrequents.addItem(make_pair(std::get<1>(cols[0]).toInt(),
-                                            std::get<1>(cols[1]).toUtf8String()));
-            return true;
-        };
-        BoundGroupByQuery(select,
-                        *boundDataset.dataset,
-                        boundDataset.asName,
-                        config.inputData.stm->when,
-                        *config.inputData.stm->where,
-                        groupBy,
-                        aggregators,
-                        *config.inputData.stm->having,
-                        *config.inputData.stm->rowName,
-                        orderBy)
-            .execute({onRow2, false /*processInParallel*/},
-                    0, // offset
-                    -1, // limit
-                    convertProgressToJson);
-        vector<Cell> toRecord;
-        for (int i = 0; i < mostFrequents.currSize; ++ i) {
-            toRecord.emplace_back(
-                value + "most_frequent_items" + mostFrequents.top[i].second,
-                mostFrequents.top[i].first,
-                now);
-        }
-        output->recordRow(rowName, toRecord);
-        first = false;
+/** Statistics of a column with non-numeric values, or no values at all. */
+vector<Cell>
+getCategoricalStats(const ColumnValueCounts & column, int64_t numRows,
+                    Date now)
+{
+    ColumnPath value("value");
+
+    MostFrequents<Utf8String, 10> mostFrequents; // Keep top 10
+    for (auto & c: column.counts)
+        mostFrequents.addItem(make_pair(c.second, c.first.toUtf8String()));
+
+    vector<Cell> result;
+    result.emplace_back(value + "data_type", "categorical", now);
+    result.emplace_back(value + "num_null", numRows - column.numNotNull, now);
+    result.emplace_back(value + "num_unique", (int64_t)column.counts.size(),
+                        now);
+    for (int i = 0; i < mostFrequents.currSize; ++ i) {
+        result.emplace_back(
+            value + "most_frequent_items" + mostFrequents.top[i].second,
+            mostFrequents.top[i].first,
+            now);
     }
-};
+    return result;
+}
 
 RunOutput
 SummaryStatisticsProcedure::
@@ -427,10 +278,6 @@ run(const ProcedureRunConfig & run,
     const std::function<bool (const Json::Value &)> & onProgress) const
 {
     auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
-    Progress bucketizeProgress;
-    std::shared_ptr<Step> iterationStep = bucketizeProgress.steps({
-        make_pair("iterating", "percentile"),
-    });
 
     SqlExpressionMldbScope context(engine);
 
@@ -446,62 +293,75 @@ run(const ProcedureRunConfig & run,
         calc.emplace_back(whenClause);
     }
 
-    int num = 0;
-    float denum = 0;
-    {
-        BoundSelectQuery bsq(runProcConf.inputData.stm->select,
-                             *boundDataset.dataset,
-                             boundDataset.asName,
-                             runProcConf.inputData.stm->when,
-                             *runProcConf.inputData.stm->where,
-                             runProcConf.inputData.stm->orderBy,
-                             calc);
-        denum = bsq.getSelectOutputInfo()->allColumnNames().size();
-    }
-    auto onProgress2 = [&](const Json::Value & progress) {
-        Json::Value v;
-        v["percent"] = num / denum;
-        return onProgress(progress);
-    };
+    BoundSelectQuery bsq(runProcConf.inputData.stm->select,
+                         *boundDataset.dataset,
+                         boundDataset.asName,
+                         runProcConf.inputData.stm->when,
+                         *runProcConf.inputData.stm->where,
+                         runProcConf.inputData.stm->orderBy,
+                         calc);
+
+    // Every selected column gets a row of statistics, even if it never
+    // has a value
+    vector<ColumnPath> columnNames
+        = bsq.getSelectOutputInfo()->allColumnNames();
+    std::unordered_map<ColumnPath, int> columnIndex;
+    for (size_t i = 0;  i < columnNames.size();  ++i)
+        columnIndex.emplace(columnNames[i], i);
+
+    // All of the statistics of all of the columns are accumulated in one
+    // parallel pass over the input
+    PerThreadAccumulator<SummaryStatisticsThreadAccum> accum
+        ([&] () { return new SummaryStatisticsThreadAccum(columnNames.size()); });
+
+    auto onRow = [&] (NamedRowValue & row,
+                      std::vector<ExpressionValue> & calcd, int rowNum)
+        {
+            auto & threadAccum = accum.get();
+            int64_t rowIndex = threadAccum.numRows++;
+            MatrixNamedRow flattened = row.flattenDestructive();
+            for (auto & c: flattened.columns) {
+                auto it = columnIndex.find(std::get<0>(c));
+                if (it == columnIndex.end()
+                    || threadAccum.lastRowSeen[it->second] == rowIndex)
+                    continue;
+                threadAccum.lastRowSeen[it->second] = rowIndex;
+                threadAccum.columns[it->second].add(std::get<1>(c));
+            }
+            return true;
+        };
 
-    Date now = Date::now();
-    auto output = createDataset(engine, runProcConf.outputDataset,
-                                nullptr, true /*overwrite*/);
+    bsq.execute(onRow, true /* processInParallel */,
+                0 /* offset */, -1 /* limit */, convertProgressToJson);
 
+    int64_t numRows = 0;
+    vector<SummaryStatisticsThreadAccum *> threads;
+    accum.forEach([&] (SummaryStatisticsThreadAccum * t)
+                  {
+                      numRows += t->numRows;
+                      threads.push_back(t);
+                  });
 
-    NumericRowHandler nrh(boundDataset, runProcConf, output, now, onProgress2);
-    CategoricalRowHandler crh(boundDataset, runProcConf, output, now,
-                                onProgress);
-    auto record = [&] (const Utf8String & expr, const Path & alias) {
-        const Utf8String name = "\"" + expr + "\"";
-        if (!nrh.recordStatsForColumn(name, alias)) {
-            crh.recordStatsForColumn(name, alias);
-        }
-    };
+    Date now = Date::now();
+    vector<pair<RowPath, vector<Cell> > > rows(columnNames.size());
+
+    auto doColumn = [&] (size_t i)
+        {
+            ColumnValueCounts column;
+            for (auto * t: threads)
+                column.merge(t->columns[i]);
+
+            rows[i].first = columnNames[i];
+            if (column.numNotNull > 0 && column.allNumeric)
+                rows[i].second = getNumericStats(column, numRows, now);
+            else rows[i].second = getCategoricalStats(column, numRows, now);
+        };
 
-    for (const auto & clause: procedureConfig.inputData.stm->select.clauses) {
-        Utf8String surface;
-        Utf8String alias;
-        if (clause->isWildcard()) {
-            BoundSelectQuery bsq(SelectExpression::parse("*"),
-                                *boundDataset.dataset,
-                                boundDataset.asName,
-                                runProcConf.inputData.stm->when,
-                                *runProcConf.inputData.stm->where,
-                                runProcConf.inputData.stm->orderBy,
-                                calc);
-            for (const auto & colName: bsq.getSelectOutputInfo()->allColumnNames()) {
-                ++ num;
-                record(colName.toSimpleName(), colName);
-            }
-            continue;
-        }
-        ++ num;
-        // static_cast -> validated already from onPostValidate
-        auto expr = static_cast<NamedColumnExpression *>(clause.get());
-        record(expr->getChildren()[0]->surface, expr->alias);
-    }
+    parallelMap(0, columnNames.size(), doColumn);
 
+    auto output = createDataset(engine, runProcConf.outputDataset,
+                                nullptr, true /*overwrite*/);
+    output->recordRows(rows);
     output->commit();
     return output->getStatus();
 }
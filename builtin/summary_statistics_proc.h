@@ -3,8 +3,8 @@
  * Mich, 2016-06-30
  * Copyright (c) 2016 mldb.ai inc. All rights reserved.
  *
- * Generates column statistics based on an input query. The statistics are
- * computed from a sequence of mldb sql queries.
+ * Generates column statistics based on an input query. The statistics of
+ * all of the columns are computed in a single parallel pass over the input.
  **/
 
 #pragma once
@@ -12,6 +12,11 @@
 #include "mldb/types/any_impl.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/engine/dataset_utils.h"
+#include "mldb/base/optimized_path.h"
+#include "mldb/base/parallel.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 
 using namespace std;
 
@@ -40,6 +45,15 @@ TransposedDatasetConfigDescription()
 /* TRANSPOSED INTERNAL REPRESENTATION                                        */
 /*****************************************************************************/
 
+/// Allow control over whether the transposition is materialized, so that
+/// we can test both with and without it.
+static const OptimizedPath optimizeMaterialize
+("mldb.TransposedDataset.materialize");
+
+/// Number of reads of transposed rows from the underlying dataset's column
+/// index before it's worth materializing the whole transposition
+static constexpr uint64_t MATERIALIZE_AFTER_LOOKUPS = 8;
+
 
 struct TransposedDataset::Itl
     : public MatrixView, public ColumnIndex {
@@ -51,6 +65,65 @@ struct TransposedDataset::Itl
     std::shared_ptr<ColumnIndex> index;
     size_t columnCount;
 
+    /** Inverted copy of the underlying dataset, with a posting list for
+        each of its columns of the rows it's set in, which is what the
+        rows of the transposition are read from.  Reading them from the
+        underlying column index instead means scanning its rows for each
+        of them, which is quadratic for a query over the whole thing.
+    */
+    struct Materialized {
+        /// Data generation of the dataset when it was built
+        uint64_t generation = 0;
+
+        /// Our rows, which are the columns of the dataset, in order
+        std::vector<RowPath> rowNames;
+
+        /// Our columns, which are the rows of the dataset
+        std::vector<ColumnPath> columnNames;
+
+        /// Index in rowNames of each row hash
+        std::unordered_map<uint64_t, uint32_t> rowIndex;
+
+        /// Row n's values are between offsets[n] and offsets[n + 1]
+        std::vector<uint64_t> offsets;
+
+        /// For each value, the index in columnNames of its column
+        std::vector<uint32_t> postingColumns;
+        std::vector<CellValue> values;
+        std::vector<Date> timestamps;
+
+        /// Return the index of the row, or -1 if it doesn't exist
+        int64_t findRow(const RowPath & rowName) const
+        {
+            auto it = rowIndex.find(rowName.hash());
+            if (it == rowIndex.end() || rowNames[it->second] != rowName)
+                return -1;
+            return it->second;
+        }
+
+        std::vector<std::tuple<ColumnPath, CellValue, Date> >
+        getRowValues(size_t row) const
+        {
+            std::vector<std::tuple<ColumnPath, CellValue, Date> > result;
+            result.reserve(offsets[row + 1] - offsets[row]);
+            for (uint64_t i = offsets[row];  i < offsets[row + 1];  ++i) {
+                result.emplace_back(columnNames[postingColumns[i]],
+                                    values[i], timestamps[i]);
+            }
+            return result;
+        }
+    };
+
+    mutable std::mutex materializedMutex;
+    mutable std::shared_ptr<const Materialized> materialized;
+
+    /// Held while building, so that only one thread does it
+    mutable std::mutex buildMutex;
+
+    /// Transposed rows read since the last time it was materialized
+    mutable std::atomic<uint64_t> numLookups{0};
+    mutable std::atomic<uint64_t> numBuilds{0};
+
     Itl(MldbEngine * engine, std::shared_ptr<Dataset> dataset)
         : dataset(dataset),
           matrix(dataset->getMatrixView()),
@@ -63,9 +136,8 @@ struct TransposedDataset::Itl
 
         TransposedRowStream(TransposedDataset::Itl* source) : source(source)
         {
-            matrix = source->matrix;
-            columns = matrix->getColumnPaths();
-            column_iterator = columns.begin();
+            rows = source->getRowPaths();
+            row_iterator = rows.begin();
         }
 
         virtual std::shared_ptr<RowStream> clone() const{
@@ -74,28 +146,24 @@ struct TransposedDataset::Itl
         }
 
         virtual void initAt(size_t start){
-            column_iterator = column_iterator + start;
+            row_iterator = row_iterator + start;
         }
 
         virtual RowPath next() {
-            return TransposedDataset::Itl::colToRow(*(column_iterator++));
+            return *(row_iterator++);
         }
 
         virtual const RowPath & rowName(RowPath & storage) const
         {
-            return storage = TransposedDataset::Itl::colToRow(*column_iterator);
+            return storage = *row_iterator;
         }
 
         virtual void advance() {
-            column_iterator++;
+            row_iterator++;
         }
 
-        //todo: suboptimal for large number of columns
-        //need a column iter interface
-        //or cache this in the transposed dataset
-        vector<ColumnPath>::const_iterator column_iterator;
-        vector<ColumnPath> columns;
-        std::shared_ptr<MatrixView> matrix;
+        vector<RowPath>::const_iterator row_iterator;
+        vector<RowPath> rows;
         TransposedDataset::Itl* source;
     };
 
@@ -173,9 +241,186 @@ struct TransposedDataset::Itl
         return std::move(row);
     }
 
+    /** Return the materialized transposition if it's up to date with the
+        dataset, building it if this is a heavy use (one that reads all
+        rows) or if enough rows have been read to make it worthwhile.
+        Otherwise returns null, and the rows are read from the dataset's
+        column index.
+    */
+    std::shared_ptr<const Materialized>
+    getMaterialized(bool heavyUse) const
+    {
+        if (!optimizeMaterialize())
+            return nullptr;
+
+        uint64_t generation = dataset->getDataGeneration();
+
+        auto getCurrent = [&] () -> std::shared_ptr<const Materialized>
+            {
+                std::unique_lock<std::mutex> guard(materializedMutex);
+                if (materialized && materialized->generation == generation)
+                    return materialized;
+                return nullptr;
+            };
+
+        if (auto result = getCurrent())
+            return result;
+
+        if (!heavyUse && ++numLookups <= MATERIALIZE_AFTER_LOOKUPS)
+            return nullptr;
+
+        std::unique_lock<std::mutex> buildGuard(buildMutex);
+
+        // Another thread may have built it while we waited
+        if (auto result = getCurrent())
+            return result;
+
+        std::shared_ptr<const Materialized> result = materialize(generation);
+        ++numBuilds;
+        numLookups = 0;
+
+        std::unique_lock<std::mutex> guard(materializedMutex);
+        materialized = result;
+        return result;
+    }
+
+    /** Build the inverted copy of the dataset.  The generation must be
+        taken before anything is read, so that a change made while it's
+        being built makes it out of date.
+
+        The rows of the dataset are read in parallel blocks, each of which
+        gives a list of values.  These are then scattered into the posting
+        lists in block order, which keeps each one in the order of the
+        dataset's rows.
+    */
+    std::shared_ptr<const Materialized>
+    materialize(uint64_t generation) const
+    {
+        static constexpr size_t ROWS_PER_BLOCK = 1024;
+
+        auto result = std::make_shared<Materialized>();
+        result->generation = generation;
+
+        for (auto & c: dataset->getFlattenedColumnNames()) {
+            result->rowIndex[c.hash()] = result->rowNames.size();
+            result->rowNames.emplace_back(colToRow(std::move(c)));
+        }
+
+        result->columnNames = matrix->getRowPaths();
+        size_t numColumns = result->columnNames.size();
+
+        struct Entry {
+            uint32_t row;     ///< Index in rowNames; -1 if not known yet
+            uint32_t column;
+            CellValue value;
+            Date ts;
+        };
+
+        struct Block {
+            std::vector<Entry> entries;
+            /// Entries of columns not in the flattened column names
+            std::vector<std::pair<size_t, RowPath> > unknown;
+        };
+
+        size_t numBlocks = (numColumns + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK;
+        std::vector<Block> blocks(numBlocks);
+
+        auto doBlock = [&] (size_t b)
+            {
+                Block & block = blocks[b];
+                size_t end = std::min(numColumns, (b + 1) * ROWS_PER_BLOCK);
+                for (size_t i = b * ROWS_PER_BLOCK;  i < end;  ++i) {
+                    auto row = matrix->getRow(colToRow(result->columnNames[i]));
+                    for (auto & c: row.columns) {
+                        ColumnPath & col = std::get<0>(c);
+                        auto it = result->rowIndex.find(col.hash());
+                        uint32_t rowNum = -1;
+                        if (it != result->rowIndex.end()
+                            && result->rowNames[it->second] == col) {
+                            rowNum = it->second;
+                        }
+                        else {
+                            block.unknown.emplace_back(block.entries.size(),
+                                                       colToRow(std::move(col)));
+                        }
+                        block.entries.push_back
+                            ({ rowNum, (uint32_t)i,
+                               std::move(std::get<1>(c)), std::get<2>(c) });
+                    }
+                }
+            };
+
+        parallelMap(0, numBlocks, doBlock);
+
+        // Columns that weren't in the list are added as rows at the end
+        for (auto & block: blocks) {
+            for (auto & u: block.unknown) {
+                uint32_t rowNum = result->findRow(u.second);
+                if (rowNum == (uint32_t)-1) {
+                    rowNum = result->rowNames.size();
+                    result->rowIndex[u.second.hash()] = rowNum;
+                    result->rowNames.emplace_back(std::move(u.second));
+                }
+                block.entries[u.first].row = rowNum;
+            }
+            block.unknown.clear();
+        }
+
+        size_t numRows = result->rowNames.size();
+        result->offsets.resize(numRows + 1, 0);
+        for (auto & block: blocks)
+            for (auto & e: block.entries)
+                ++result->offsets[e.row + 1];
+        for (size_t i = 0;  i < numRows;  ++i)
+            result->offsets[i + 1] += result->offsets[i];
+
+        size_t numValues = result->offsets[numRows];
+        result->postingColumns.resize(numValues);
+        result->values.resize(numValues);
+        result->timestamps.resize(numValues);
+
+        std::vector<uint64_t> pos(result->offsets.begin(),
+                                  result->offsets.end() - 1);
+        for (auto & block: blocks) {
+            for (auto & e: block.entries) {
+                uint64_t p = pos[e.row]++;
+                result->postingColumns[p] = e.column;
+                result->values[p] = std::move(e.value);
+                result->timestamps[p] = e.ts;
+            }
+            block.entries = std::vector<Entry>();
+        }
+
+        return result;
+    }
+
+    Json::Value getMaterializedStatus() const
+    {
+        Json::Value result;
+        std::shared_ptr<const Materialized> current;
+        {
+            std::unique_lock<std::mutex> guard(materializedMutex);
+            current = materialized;
+        }
+        result["materialized"]
+            = current
+            && current->generation == dataset->getDataGeneration();
+        result["numMaterializations"] = numBuilds.load();
+        if (current) {
+            result["materializedRows"] = current->rowNames.size();
+            result["materializedValues"] = current->values.size();
+        }
+        return result;
+    }
+
     virtual std::vector<RowPath>
     getRowPaths(ssize_t start = 0, ssize_t limit = -1) const
     {
+        if (auto m = getMaterialized(true /* heavyUse */)) {
+            vector<RowPath> result = m->rowNames;
+            return applyOffsetLimit(start, limit, result);
+        }
+
         vector<ColumnPath> cols = dataset->getFlattenedColumnNames();
 
         vector<RowPath> result;
@@ -185,14 +430,14 @@ struct TransposedDataset::Itl
             result.push_back(colToRow(cols[i]));
         }
         
-        return cols;
+        return result;
     }
 
     virtual std::vector<RowHash>
     getRowHashes(ssize_t start = 0, ssize_t limit = -1) const
     {
         vector<RowHash> result;
-        for (auto & n: getRowPaths()) {
+        for (auto & n: getRowPaths(start, limit)) {
             result.emplace_back(n);
         }
         return result;
@@ -200,6 +445,8 @@ struct TransposedDataset::Itl
 
     virtual bool knownRow(const RowPath & rowName) const
     {
+        if (auto m = getMaterialized(false /* heavyUse */))
+            return m->findRow(rowName) != -1;
         return index->knownColumn(rowToCol(rowName));
     }
 
@@ -220,6 +467,16 @@ struct TransposedDataset::Itl
 
     virtual MatrixNamedRow getRow(const RowPath & rowName) const
     {
+        if (auto m = getMaterialized(false /* heavyUse */)) {
+            MatrixNamedRow result;
+            result.rowName = rowName;
+            result.rowHash = rowName;
+            int64_t row = m->findRow(rowName);
+            if (row != -1)
+                result.columns = m->getRowValues(row);
+            return result;
+        }
+
         MatrixColumn col = index->getColumn(rowToCol(rowName));
         MatrixNamedRow result;
         result.rowName = colToRow(std::move(col.columnName));
@@ -230,6 +487,13 @@ struct TransposedDataset::Itl
 
     virtual ExpressionValue getRowExpr(const RowPath & rowName) const
     {
+        if (auto m = getMaterialized(false /* heavyUse */)) {
+            int64_t row = m->findRow(rowName);
+            if (row == -1)
+                return ExpressionValue();
+            return m->getRowValues(row);
+        }
+
         MatrixColumn col = index->getColumn(rowToCol(rowName));
         return std::move(col.rows);
     }
@@ -284,6 +548,18 @@ struct TransposedDataset::Itl
 
     virtual uint64_t getRowColumnCount(const RowPath & row) const
     {
+        if (auto m = getMaterialized(false /* heavyUse */)) {
+            int64_t n = m->findRow(row);
+            if (n == -1)
+                return 0;
+            // Values of the same column are next to each other
+            uint64_t result = 0;
+            for (uint64_t i = m->offsets[n];  i < m->offsets[n + 1];  ++i) {
+                result += i == m->offsets[n]
+                    || m->postingColumns[i] != m->postingColumns[i - 1];
+            }
+            return result;
+        }
         return index->getColumnRowCount(rowToCol(row));
     }
 
@@ -352,7 +628,14 @@ Any
 TransposedDataset::
 getStatus() const
 {
-    return Any();
+    return itl->getMaterializedStatus();
+}
+
+uint64_t
+TransposedDataset::
+getDataGeneration() const
+{
+    return itl->dataset->getDataGeneration();
 }
 
 std::pair<Date, Date>
@@ -40,8 +40,16 @@ struct TransposedDataset: public Dataset {
 
     virtual ~TransposedDataset();
 
+    /** Tells whether the transposition is currently materialized.  It's
+        built the first time that all of its rows are read or once enough
+        rows have been read one by one, and rebuilt the next time it's
+        used after the data generation of the dataset changes.
+    */
     virtual Any getStatus() const;
 
+    /// The data generation of the transposed dataset
+    virtual uint64_t getDataGeneration() const;
+
     virtual std::pair<Date, Date> getTimestampRange() const;
 
     virtual std::shared_ptr<MatrixView> getMatrixView() const;
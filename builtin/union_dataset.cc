@@ -10,10 +10,12 @@
 
 #include "mldb/builtin/id_hash.h"
 #include "mldb/builtin/merge_hash_entries.h"
+#include "mldb/arch/bitops.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/engine/dataset_utils.h"
+#include "mldb/sql/sql_expression.h"
 
 using namespace std;
 
@@ -51,7 +53,7 @@ std::shared_ptr<Dataset> createUnionDataset(
 struct UnionDataset::Itl
     : public MatrixView, public ColumnIndex {
 
-    LightweightHash<RowHash, pair<int, RowHash> > rowIndex;
+    SwissHash<RowHash, pair<int, RowHash> > rowIndex;
     IdHashes columnIndex;
 
     // Datasets that it was constructed with
@@ -122,15 +124,22 @@ struct UnionDataset::Itl
         return idx;
     }
 
+    /** Row stream over the union, which goes through the row stream of
+        each of the datasets in turn.  The child streams are passed in
+        as prototypes that are cloned for each dataset that is visited.
+    */
     struct UnionRowStream : public RowStream {
 
-        UnionRowStream(const UnionDataset::Itl* source) : source(source), datasetIndex(0)
+        UnionRowStream(const UnionDataset::Itl* source,
+                       vector<std::shared_ptr<RowStream> > childStreams)
+            : source(source), childStreams(std::move(childStreams)),
+              datasetIndex(0), subRowIndex(0), subNumRow(0)
         {
         }
 
         virtual std::shared_ptr<RowStream> clone() const override
         {
-            return make_shared<UnionRowStream>(source);
+            return make_shared<UnionRowStream>(source, childStreams);
         }
 
         /* set where the stream should start*/
@@ -138,33 +147,78 @@ struct UnionDataset::Itl
         {
             datasetIndex = 0;
             size_t currentTotal = 0;
-            std::shared_ptr<Dataset> currentDataset = source->datasets[0];
-            size_t currentRowCount = currentDataset->getRowCount();
-            while (currentTotal + currentRowCount < start) {
+            size_t currentRowCount = source->datasets[0]->getRowCount();
+            while (currentTotal + currentRowCount <= start
+                   && datasetIndex + 1 < source->datasets.size()) {
                 currentTotal += currentRowCount;
                 ++datasetIndex;
-                currentDataset = source->datasets[datasetIndex];
-                currentRowCount = currentDataset->getRowCount();
+                currentRowCount = source->datasets[datasetIndex]->getRowCount();
             }
-            currentSubRowStream = currentDataset->getRowStream();
+            currentSubRowStream = childStreams[datasetIndex]->clone();
             subRowIndex = start - currentTotal;
             currentSubRowStream->initAt(subRowIndex);
             subNumRow = currentRowCount;
+            skipFinishedDatasets();
+        }
+
+        /** Split along the datasets, and within each dataset along the
+            streams that it splits itself into.
+        */
+        virtual std::vector<std::shared_ptr<RowStream> >
+        parallelize(int64_t rowStreamTotalRows,
+                    ssize_t approxNumberOfChildStreams,
+                    std::vector<size_t> * streamOffsets) const override
+        {
+            std::vector<std::shared_ptr<RowStream> > streams;
+            if (streamOffsets)
+                streamOffsets->clear();
+
+            size_t startAt = 0;
+            for (size_t i = 0;  i < source->datasets.size();  ++i) {
+                size_t numRows = source->datasets[i]->getRowCount();
+                if (numRows == 0)
+                    continue;
+
+                // Give each dataset its share of the streams
+                ssize_t numChildStreams = AUTO;
+                if (approxNumberOfChildStreams != AUTO) {
+                    numChildStreams
+                        = std::max<ssize_t>(1, approxNumberOfChildStreams
+                                               * numRows / rowStreamTotalRows);
+                }
+
+                std::vector<size_t> childOffsets;
+                auto childStreams = this->childStreams[i]
+                    ->parallelize(numRows, numChildStreams, &childOffsets);
+
+                for (size_t j = 0;  j < childStreams.size();  ++j) {
+                    if (streamOffsets)
+                        streamOffsets->push_back(startAt + childOffsets[j]);
+                    auto stream = std::make_shared<UnionRowStream>
+                        (source, this->childStreams);
+                    stream->datasetIndex = i;
+                    stream->currentSubRowStream = std::move(childStreams[j]);
+                    stream->subRowIndex = childOffsets[j];
+                    stream->subNumRow = numRows;
+                    streams.emplace_back(std::move(stream));
+                }
+
+                startAt += numRows;
+            }
+
+            if (streamOffsets)
+                streamOffsets->push_back(startAt);
+
+            ExcAssertEqual(startAt, rowStreamTotalRows);
+
+            return streams;
         }
 
         virtual RowPath next() override
         {
             RowPath mynext = PathElement(datasetIndex) + currentSubRowStream->next();
             ++subRowIndex;
-            if (subRowIndex == subNumRow) {
-                ++datasetIndex;
-                if (datasetIndex < source->datasets.size()) {
-                    currentSubRowStream = source->datasets[datasetIndex]->getRowStream();
-                    currentSubRowStream->initAt(0);
-                    subRowIndex = 0;
-                    subNumRow = source->datasets[datasetIndex]->getRowCount();
-                }
-            }
+            skipFinishedDatasets();
             return mynext;
         }
 
@@ -174,25 +228,110 @@ struct UnionDataset::Itl
             return storage = PathElement(datasetIndex) + sub;
         }
 
+        virtual bool supportsExtendedInterface() const override
+        {
+            for (auto & s: childStreams) {
+                if (!s->supportsExtendedInterface())
+                    return false;
+            }
+            return true;
+        }
+
+        virtual void advance() override
+        {
+            currentSubRowStream->advance();
+            ++subRowIndex;
+            skipFinishedDatasets();
+        }
+
+        virtual void advanceBy(size_t n) override
+        {
+            while (n > 0) {
+                size_t toAdvance = std::min(n, subNumRow - subRowIndex);
+                ExcAssertGreater(toAdvance, 0);
+                currentSubRowStream->advanceBy(toAdvance);
+                subRowIndex += toAdvance;
+                n -= toAdvance;
+                skipFinishedDatasets();
+            }
+        }
+
+        /// The columns are the same in the union as in the datasets, so
+        /// we can extract them from each of the datasets in turn.
+        virtual void
+        extractColumns(size_t numRows,
+                       const std::vector<ColumnPath> & columnNames,
+                       CellValue * output) override
+        {
+            while (numRows > 0) {
+                size_t toExtract = std::min(numRows, subNumRow - subRowIndex);
+                ExcAssertGreater(toExtract, 0);
+                currentSubRowStream->extractColumns(toExtract, columnNames,
+                                                    output);
+                output += toExtract * columnNames.size();
+                subRowIndex += toExtract;
+                numRows -= toExtract;
+                skipFinishedDatasets();
+            }
+        }
+
+        /// Once we've gone through all rows of the current dataset, move
+        /// on to the start of the next one that has rows
+        void skipFinishedDatasets()
+        {
+            while (subRowIndex == subNumRow
+                   && datasetIndex + 1 < source->datasets.size()) {
+                ++datasetIndex;
+                currentSubRowStream = childStreams[datasetIndex]->clone();
+                currentSubRowStream->initAt(0);
+                subRowIndex = 0;
+                subNumRow = source->datasets[datasetIndex]->getRowCount();
+            }
+        }
+
         const UnionDataset::Itl* source;
+        vector<std::shared_ptr<RowStream> > childStreams;
         size_t datasetIndex;
         size_t subRowIndex;
         size_t subNumRow;
         std::shared_ptr<RowStream> currentSubRowStream;
     };
 
+    /** Return a row stream over the union, or a null pointer if one of the
+        datasets doesn't have a row stream.
+    */
+    std::shared_ptr<RowStream> getRowStream() const
+    {
+        vector<std::shared_ptr<RowStream> > childStreams;
+        for (auto & d: datasets) {
+            childStreams.emplace_back(d->getRowStream());
+            if (!childStreams.back())
+                return nullptr;
+        }
+        return make_shared<UnionRowStream>(this, std::move(childStreams));
+    }
+
     virtual vector<Path>
     getRowPaths(ssize_t start = 0, ssize_t limit = -1) const
     {
         // Row names are idx.rowPath where idx is the index of the dataset
-        // in the union and rowPath is the original rowPath.
+        // in the union and rowPath is the original rowPath.  Datasets that
+        // are entirely before start or after the limit aren't looked at.
         vector<RowPath> result;
         for (int i = 0; i < datasets.size(); ++i) {
+            if (limit != -1 && result.size() >= (size_t)limit)
+                break;
             const auto & d = datasets[i];
-            for (const auto & name: d->getMatrixView()->getRowPaths()) {
+            size_t numRows = d->getRowCount();
+            if ((size_t)start >= numRows) {
+                start -= numRows;
+                continue;
+            }
+            ssize_t subLimit = limit == -1 ? -1 : limit - result.size();
+            for (auto & name: d->getMatrixView()->getRowPaths(start, subLimit)) {
                 result.emplace_back(PathElement(i) + name);
             }
-
+            start = 0;
         }
         return result;
     }
@@ -432,7 +571,25 @@ std::shared_ptr<RowStream>
 UnionDataset::
 getRowStream() const
 {
-    return make_shared<UnionDataset::Itl::UnionRowStream>(itl.get());
+    return itl->getRowStream();
+}
+
+GenerateRowsWhereFunction
+UnionDataset::
+generateRowsWhere(const SqlBindingScope & context,
+                  const Utf8String& alias,
+                  const SqlExpression & where,
+                  ssize_t offset,
+                  ssize_t limit) const
+{
+    // A constant where is a scan of the union row stream, which is already
+    // split along the datasets.  The row names of the datasets are not
+    // those of the union, so we can't push down anything that reads them.
+    if (where.isConstant() || readsRowIdentity(where))
+        return Dataset::generateRowsWhere(context, alias, where, offset, limit);
+
+    return generateChildRowsWhere(itl->datasets, context, alias, where,
+                                  true /* prefixChildIndex */);
 }
 
 ExpressionValue
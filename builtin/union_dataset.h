@@ -53,6 +53,17 @@ struct UnionDataset: public Dataset {
     virtual std::pair<Date, Date> getTimestampRange() const override;
     virtual ExpressionValue getRowExpr(const RowPath & rowPath) const override;
 
+    /** Push the where expression down into each of the datasets, so that
+        they can use their own indexes, unless it needs the row names of
+        the union.
+    */
+    virtual GenerateRowsWhereFunction
+    generateRowsWhere(const SqlBindingScope & context,
+                      const Utf8String& alias,
+                      const SqlExpression & where,
+                      ssize_t offset,
+                      ssize_t limit) const override;
+
 private:
     UnionDatasetConfig datasetConfig;
     struct Itl;
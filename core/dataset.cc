@@ -9,6 +9,7 @@
 
 #include "mldb/compiler/compiler.h"
 #include "mldb/core/dataset.h"
+#include "mldb/core/geo_point_index.h"
 #include "mldb/core/mldb_engine.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/sql/sql_expression_operations.h"
@@ -16,6 +17,7 @@
 #include "mldb/types/vector_description.h"
 #include "mldb/engine/analytics.h"
 #include "mldb/sql/sql_expression.h"
+#include "mldb/sql/sql_batch.h"
 #include "mldb/sql/sql_utils.h"
 #include "mldb/utils/lightweight_hash.h"
 #include "mldb/utils/profile.h"
@@ -30,7 +32,10 @@
 #include "mldb/rest/rest_request_router.h"
 #include "mldb/types/hash_wrapper_description.h"
 #include "mldb/rest/cancellation_exception.h"
+#include "mldb/rest/latency_metrics.h"
+#include "mldb/base/optimized_path.h"
 #include <mutex>
+#include <map>
 
 
 using namespace std;
@@ -179,6 +184,25 @@ extractNumbers(size_t numValues,
         output[i] = tmpOutput[i].toDouble();
     }
 }
+
+void
+RowStream::
+extractColumnBatches(size_t numValues,
+                     const std::vector<ColumnPath> & columnNames,
+                     SqlBatchVector * output)
+{
+    size_t nc = columnNames.size();
+    std::unique_ptr<CellValue[]> tmpOutput(new CellValue[numValues * nc]);
+
+    extractColumns(numValues, columnNames, tmpOutput.get());
+
+    for (size_t i = 0;  i < nc;  ++i) {
+        std::vector<CellValue> values(numValues);
+        for (size_t j = 0;  j < numValues;  ++j)
+            values[j] = std::move(tmpOutput[j * nc + i]);
+        output[i].initCells(std::move(values));
+    }
+}
     
 
 
@@ -439,50 +463,27 @@ getColumnBuckets(const ColumnPath & column,
                  int maxNumBuckets) const
 {
     auto vals = getColumnDense(column);
-    std::vector<std::pair<CellValue, uint32_t> > vals2;
-    vals2.reserve(vals.size());
-    for (size_t i = 0;  i < vals.size();  ++i) {
-        vals2.emplace_back(std::move(vals[i]), i);
-    }
-    vals.clear();  vals.shrink_to_fit();
 
-    std::sort(vals2.begin(), vals2.end());
+    BucketDescriptions descriptions;
+    descriptions.initialize(vals, maxNumBuckets);
 
-    size_t totalRows = vals2.size();
+    // Look up the bucket of each value directly, rather than sorting them
+    // to group equal values
+    std::vector<uint32_t> bucketNumbers(vals.size());
 
-    std::vector<CellValue> distinctValues;
-    std::vector<uint32_t> startsAt;
-    for (size_t i = 0;  i < vals2.size();  ++i) {
-        auto & v = vals2[i];
-        if (distinctValues.empty()
-            || v.first != distinctValues.back()) {
-            distinctValues.emplace_back(std::move(v.first));
-            startsAt.push_back(i);
-        }
-    }
-    startsAt.push_back(vals2.size());
-    
-    BucketDescriptions descriptions;
-    descriptions.initialize(distinctValues, maxNumBuckets);
-
-    std::vector<int32_t> bucketNumbers(vals2.size(), -1);
-    for (size_t i = 0;  i < distinctValues.size();  ++i) {
-        uint32_t bucket = descriptions.getBucket(distinctValues[i]);
-        size_t startAt = startsAt[i];
-        size_t endAt = startsAt[i + 1];
-        for (size_t j = startAt;  j < endAt;  ++j) {
-            bucketNumbers[vals2[j].second] = bucket;
-        }
-    }
+    auto doRange = [&] (size_t start, size_t end)
+        {
+            descriptions.getBuckets(vals.data() + start, end - start,
+                                    bucketNumbers.data() + start);
+        };
 
-    distinctValues.clear();  distinctValues.shrink_to_fit();
-    vals2.clear();  vals2.shrink_to_fit();
+    parallelMapChunked(0, vals.size(), 16384, doRange);
 
-    WritableBucketList buckets(totalRows, descriptions.numBuckets());
-    for (auto & b: bucketNumbers) {
-        ExcAssert(b != -1);
-        buckets.write(b);
-    }
+    vals.clear();  vals.shrink_to_fit();
+
+    WritableBucketList buckets(bucketNumbers.size(),
+                               descriptions.numBuckets());
+    buckets.writeParallel(bucketNumbers.data(), bucketNumbers.size());
 
     return std::make_tuple(std::move(buckets), std::move(descriptions));
 }
@@ -618,6 +619,7 @@ recordRow(const RowPath & rowName,
 {
     validateNames(rowName, vals);
     recordRowItl(rowName, vals);
+    dataChanged();
 }
 
 void
@@ -839,6 +841,17 @@ getRowExpr(const RowPath & row) const
     return std::move(flattened.columns);
 }
 
+std::function<ExpressionValue (const RowPath & row)>
+Dataset::
+getRowExprProjection(const UnboundEntities & unbound,
+                     const Utf8String & alias) const
+{
+    return [this] (const RowPath & row)
+        {
+            return this->getRowExpr(row);
+        };
+}
+
 std::vector<MatrixNamedRow>
 Dataset::
 queryStructured(const SelectExpression & select,
@@ -872,6 +885,10 @@ queryStructured(const SelectExpression & select,
     return output;
 }
 
+static LatencyMetric datasetQueryLatency
+    ("mldb_dataset_query_duration_seconds",
+     "Time taken by queries over a single dataset, by dataset type");
+
 std::tuple<std::vector<NamedRowValue>, std::shared_ptr<ExpressionValueInfo> >
 Dataset::
 queryStructuredExpr(const SelectExpression & select,
@@ -889,6 +906,8 @@ queryStructuredExpr(const SelectExpression & select,
 {
     ExcAssert(having);
     ExcAssert(rowName);
+    LatencyTimer timer(datasetQueryLatency.get
+                       ({ { "type", getMetricsType() } }));
     std::vector<NamedRowValue> output;
     std::shared_ptr<ExpressionValueInfo> structureInfo;
 
@@ -1230,6 +1249,365 @@ generateRowPathIsExpression(const Dataset & dataset,
             "generate single row matching rowPath() expression"};
 }
 
+/** Return those of the given rows for which the bound where expression is
+    true.  The columns of the rows are only read if needsColumns is set.
+    Large lists of rows are filtered in parallel, in which case the output
+    is sorted by row hash to keep it deterministic; otherwise it's in the
+    same order as the input.
+*/
+static std::vector<RowPath>
+filterRowsWhere(const Dataset & dataset,
+                const BoundSqlExpression & whereBound,
+                bool needsColumns,
+                const std::vector<RowPath> & rows,
+                const BoundParameters & params,
+                const ProgressFunc & onProgress)
+{
+    std::vector<RowPath> rowsToKeep;
+
+    PerThreadAccumulator<std::vector<RowPath> > accum;
+                
+    size_t numRows = rows.size();
+    std::atomic_ulong rowCount(0);
+
+    ProgressState whereProgress(numRows);
+    auto onRow = [&] (size_t n)
+        {
+            ++rowCount;
+
+            if (rowCount % PROGRESS_RATE == 0) {
+                if (onProgress) {
+                    whereProgress = rowCount;
+                    if (!onProgress(whereProgress)) {
+                        return false;
+                    }
+                }
+            }
+
+            const RowPath & r = rows[n];
+
+            ExpressionValue row;
+            if (needsColumns)
+                row = dataset.getRowExpr(r);
+
+            auto rowScope = SqlExpressionDatasetScope::getRowScope(r, row, &params);
+                        
+            bool keep = whereBound(rowScope, GET_LATEST).isTrue();
+                        
+            if (keep)
+                accum.get().push_back(r);
+
+            return true;
+        };
+
+    bool needSort = false;
+    if (rows.size() >= 1000) {
+        // Scan the whole lot with the when in parallel
+        if (!parallelMapHaltable(0, rows.size(), onRow))
+            throw CancellationException("row where generation was cancelled");
+
+        needSort = true;
+    } else {
+        // Serial, since probably it's not worth the overhead
+        // to run them in parallel.
+        for (unsigned i = 0;  i < rows.size();  ++i)
+            if (!onRow(i))
+                throw CancellationException("row where generation was cancelled");
+    }
+
+    // Now merge together the results of all the threads
+    auto onThreadOutput = [&] (std::vector<RowPath> * vec)
+        {
+            rowsToKeep.insert(rowsToKeep.end(),
+                              std::make_move_iterator(vec->begin()),
+                              std::make_move_iterator(vec->end()));
+        };
+                
+    accum.forEach(onThreadOutput);
+
+    //Need sorting because the parallelisation breaks determinism
+    if (needSort) 
+        parallelQuickSortRecursive<RowPath, SortByRowHash>(rowsToKeep.begin(), rowsToKeep.end());
+
+    return rowsToKeep;
+}
+
+GenerateRowsWhereFunction
+generateFilteredRows(const Dataset & dataset,
+                     const Utf8String & alias,
+                     GenerateRowsWhereFunction gen,
+                     const SqlExpression & filter)
+{
+    auto datasetPtr = &dataset;
+    SqlExpressionDatasetScope dsScope(dataset, alias);
+    auto filterBound = filter.bind(dsScope);
+    bool needsColumns = filter.getUnbound().needsRow();
+
+    Utf8String explain = "filter rows from " + gen.explain + " by "
+        + filter.print();
+
+    return {[=] (ssize_t numToGenerate, Any token,
+                 const BoundParameters & params,
+                 const ProgressFunc & onProgress)
+            -> std::pair<std::vector<RowPath>, Any>
+            {
+                auto rows = gen(-1, Any(), params, onProgress).first;
+                return { filterRowsWhere(*datasetPtr, filterBound, needsColumns, rows,
+                                         params, onProgress),
+                         Any() };
+            },
+            explain,
+            GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
+}
+
+/** Is the expression one whose value is known before any row is read,
+    that is a constant or a query parameter?
+*/
+static bool isConstantOrParameter(const SqlExpression & expr)
+{
+    return dynamic_cast<const BoundParameterExpression *>(&expr)
+        || expr.isConstant();
+}
+
+/** Is the where expression a constraint on the value of a single column
+    that is false when the column is null?  That's the case for
+    comparisons of the column with a constant other than !=, BETWEEN,
+    IN (constant, ...), LIKE with a constant pattern and IS NOT NULL, as
+    well as conjunctions of these on the same column.  If so, the column
+    is returned in columnName.
+*/
+static bool
+getColumnConstraint(const Utf8String & alias,
+                    const SqlExpression & where,
+                    ColumnPath & columnName)
+{
+    auto onColumn = [&] (const SqlExpression & expr)
+        {
+            auto variable = dynamic_cast<const ReadColumnExpression *>(&expr);
+            if (!variable)
+                return false;
+            ColumnPath column = removeTableName(alias, variable->columnName);
+            if (column.empty())
+                return false;
+            if (!columnName.empty() && column != columnName)
+                return false;
+            columnName = std::move(column);
+            return true;
+        };
+
+    if (auto boolean = dynamic_cast<const BooleanOperatorExpression *>(&where)) {
+        return boolean->op == "AND" && boolean->lhs && boolean->rhs
+            && getColumnConstraint(alias, *boolean->lhs, columnName)
+            && getColumnConstraint(alias, *boolean->rhs, columnName);
+    }
+
+    if (auto comparison = dynamic_cast<const ComparisonExpression *>(&where)) {
+        static const std::set<std::string> ops
+            = { "=", "==", "<", "<=", ">", ">=" };
+        if (!ops.count(comparison->op))
+            return false;
+        if (isConstantOrParameter(*comparison->rhs))
+            return onColumn(*comparison->lhs);
+        if (isConstantOrParameter(*comparison->lhs))
+            return onColumn(*comparison->rhs);
+        return false;
+    }
+
+    if (auto between = dynamic_cast<const BetweenExpression *>(&where)) {
+        return !between->notBetween
+            && isConstantOrParameter(*between->lower)
+            && isConstantOrParameter(*between->upper)
+            && onColumn(*between->expr);
+    }
+
+    if (auto in = dynamic_cast<const InExpression *>(&where)) {
+        return !in->isNegative && in->tuple && in->tuple->isConstant()
+            && onColumn(*in->expr);
+    }
+
+    if (auto like = dynamic_cast<const LikeExpression *>(&where)) {
+        auto pattern = dynamic_cast<const ConstantExpression *>(like->right.get());
+        return !like->isNegative && pattern
+            && pattern->constant.isString()
+            && onColumn(*like->left);
+    }
+
+    if (auto isType = dynamic_cast<const IsTypeExpression *>(&where)) {
+        return isType->type == "null" && isType->notType
+            && onColumn(*isType->expr);
+    }
+
+    return false;
+}
+
+/// Allow control over whether geo point indexes are used to find rows, so
+/// that we can test both with and without them
+static const OptimizedPath optimizeGeoIndex("mldb.Dataset.geoIndex");
+
+/** Is the expression one that can be evaluated before any row is read,
+    because it depends on nothing but constants and query parameters?
+*/
+static bool dependsOnlyOnParameters(const SqlExpression & expr)
+{
+    auto unbound = expr.getUnbound();
+    return unbound.vars.empty() && unbound.tables.empty()
+        && unbound.wildcards.empty() && !unbound.hasRowFunctions()
+        && !unbound.funcs.count("rowName");
+}
+
+/** Return a function that generates the rows matching a where expression
+    that tests a point read from two columns against a region, using the
+    geo point index of the dataset over the columns.  That's the case for
+
+    - geo_distance(lat, lon, lat2, lon2) < r (or <=, or r > ..., or with
+      the two points swapped), where lat and lon are columns and lat2, lon2
+      and r depend only on the query parameters;
+    - ST_Contains_Point(geometry, lat, lon), where the geometry depends only
+      on the query parameters.
+
+    The index gives the rows with a point in the bounding box of the region,
+    and the where expression is evaluated on each of them to keep only the
+    exact matches.  Returns a null function for other expressions.
+*/
+static GenerateRowsWhereFunction
+generateGeoRowsWhere(const Dataset & dataset,
+                     const SqlBindingScope & scope,
+                     const Utf8String & alias,
+                     const SqlExpression & where)
+{
+    if (!optimizeGeoIndex())
+        return GenerateRowsWhereFunction();
+
+    auto getColumn = [&] (const SqlExpression & expr) -> ColumnPath
+        {
+            auto variable = dynamic_cast<const ReadColumnExpression *>(&expr);
+            if (!variable)
+                return ColumnPath();
+            return removeTableName(alias, variable->columnName);
+        };
+
+    auto getCall = [] (const SqlExpression & expr, const char * name,
+                       size_t numArgs) -> const FunctionCallExpression *
+        {
+            auto call = dynamic_cast<const FunctionCallExpression *>(&expr);
+            if (!call || !call->tableName.empty()
+                || call->functionName != name || call->args.size() != numArgs)
+                return nullptr;
+            return call;
+        };
+
+    ColumnPath latitude, longitude;
+    std::vector<std::shared_ptr<SqlExpression> > regionArgs;
+    bool isDistance = false;
+
+    if (auto comparison = dynamic_cast<const ComparisonExpression *>(&where)) {
+        const FunctionCallExpression * call = nullptr;
+        std::shared_ptr<SqlExpression> limit;
+        if (comparison->op == "<" || comparison->op == "<=") {
+            call = getCall(*comparison->lhs, "geo_distance", 4);
+            limit = comparison->rhs;
+        }
+        else if (comparison->op == ">" || comparison->op == ">=") {
+            call = getCall(*comparison->rhs, "geo_distance", 4);
+            limit = comparison->lhs;
+        }
+        if (!call || !dependsOnlyOnParameters(*limit))
+            return GenerateRowsWhereFunction();
+
+        // Either point may be the one read from the row
+        for (int first: { 0, 2 }) {
+            int other = 2 - first;
+            latitude = getColumn(*call->args[first]);
+            longitude = getColumn(*call->args[first + 1]);
+            if (!latitude.empty() && !longitude.empty()
+                && dependsOnlyOnParameters(*call->args[other])
+                && dependsOnlyOnParameters(*call->args[other + 1])) {
+                regionArgs = { call->args[other], call->args[other + 1],
+                               limit };
+                break;
+            }
+        }
+        isDistance = true;
+    }
+    else if (auto call = getCall(where, "ST_Contains_Point", 3)) {
+        latitude = getColumn(*call->args[1]);
+        longitude = getColumn(*call->args[2]);
+        if (!latitude.empty() && !longitude.empty()
+            && dependsOnlyOnParameters(*call->args[0]))
+            regionArgs = { call->args[0] };
+    }
+
+    if (regionArgs.empty())
+        return GenerateRowsWhereFunction();
+
+    // Bring the query parameters into scope
+    SqlExpressionParamScope paramScope(const_cast<SqlBindingScope &>(scope));
+    std::vector<BoundSqlExpression> boundArgs;
+    for (auto & arg: regionArgs)
+        boundArgs.emplace_back(arg->bind(paramScope));
+
+    auto datasetPtr = &dataset;
+
+    auto candidates = [=] (ssize_t numToGenerate, Any token,
+                           const BoundParameters & params,
+                           const ProgressFunc & onProgress)
+        -> std::pair<std::vector<RowPath>, Any>
+        {
+            auto allRows = [&] () -> std::pair<std::vector<RowPath>, Any>
+                {
+                    return { datasetPtr->getMatrixView()->getRowPaths(),
+                             Any() };
+                };
+
+            auto index = datasetPtr->getGeoPointIndex(latitude, longitude);
+            if (!index)
+                return allRows();
+
+            // ST_Contains_Point() fails on a row without a point, which
+            // only a scan can report
+            if (!isDistance
+                && index->numRows() != datasetPtr->getMatrixView()->getRowCount())
+                return allRows();
+
+            SqlExpressionParamScope::RowScope rowScope(params);
+            std::vector<ExpressionValue> args;
+            for (auto & arg: boundArgs)
+                args.emplace_back(arg(rowScope, GET_LATEST));
+
+            GeoBoundingBox box;
+            try {
+                if (isDistance) {
+                    for (auto & arg: args) {
+                        if (!arg.isAtom() || !arg.getAtom().isNumber()) {
+                            // Null distances match nothing; anything
+                            // else is left for the scan to deal with
+                            if (arg.empty())
+                                return { {}, Any() };
+                            return allRows();
+                        }
+                    }
+                    box = getGeoDistanceBounds(args[0].getAtom().toDouble(),
+                                               args[1].getAtom().toDouble(),
+                                               args[2].getAtom().toDouble());
+                }
+                else box = getGeoJsonBounds(args[0]);
+            } catch (const std::exception & exc) {
+                // Have the scan report the error, if there is one
+                return allRows();
+            }
+
+            return { index->findRows(box), Any() };
+        };
+
+    GenerateRowsWhereFunction gen
+        (candidates,
+         "geo point index over columns '" + latitude.toUtf8String()
+         + "' and '" + longitude.toUtf8String() + "'",
+         GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN);
+
+    return generateFilteredRows(dataset, alias, std::move(gen), where);
+}
+
 /*
     Must return the *exact* set of rows or a stream that will do the same
     because the where expression will not be evaluated outside of this method
@@ -1394,6 +1772,16 @@ generateRowsWhere(const SqlBindingScope & scope,
         // Optimize a boolean operator
         if (boolean->op == "AND") {
 
+            // A conjunction of constraints on the same column, such as
+            // x >= 1 AND x < 10, can be found in one pass over the column
+            ColumnPath columnName;
+            if (getColumnConstraint(alias, where, columnName)) {
+                auto gen = generateColumnWhere(scope, alias, where,
+                                               columnName);
+                if (gen)
+                    return gen;
+            }
+
             bool isLeftRowName = isRowNameFilter(*boolean->lhs);
             bool isRightRowName = isRowNameFilter(*boolean->rhs);
             bool isLeftRowPath = isRowPathFilter(*boolean->lhs);
@@ -1503,6 +1891,17 @@ generateRowsWhere(const SqlBindingScope & scope,
                         GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
             }
 
+            // If only one side can be found without scanning the table, we
+            // generate its rows and test the other side on each of them
+            if (lhsGen.complexity < GenerateRowsWhereFunction::UNFILTERED_TABLESCAN) {
+                return generateFilteredRows(*this, alias, std::move(lhsGen),
+                                            *boolean->rhs);
+            }
+            if (rhsGen.complexity < GenerateRowsWhereFunction::UNFILTERED_TABLESCAN) {
+                return generateFilteredRows(*this, alias, std::move(rhsGen),
+                                            *boolean->lhs);
+            }
+
         }
         else if (boolean->op == "OR") {
             GenerateRowsWhereFunction lhsGen
@@ -1510,7 +1909,10 @@ generateRowsWhere(const SqlBindingScope & scope,
             GenerateRowsWhereFunction rhsGen
                 = generateRowsWhere(scope, alias, *boolean->rhs, 0, -1);
 
-            if (lhsGen.explain != "scan table" && rhsGen.explain != "scan table") {
+            // A union is only worth it if neither side needs to scan the
+            // table; otherwise a single scan is cheaper
+            if (lhsGen.complexity < GenerateRowsWhereFunction::UNFILTERED_TABLESCAN
+                && rhsGen.complexity < GenerateRowsWhereFunction::UNFILTERED_TABLESCAN) {
                 return {[=] (ssize_t numToGenerate, Any token,
                              const BoundParameters & params,
                              const ProgressFunc & onProgress)
@@ -1683,6 +2085,10 @@ generateRowsWhere(const SqlBindingScope & scope,
         }
     }
     
+    // Optimize for points in a region, with a geo point index
+    if (auto gen = generateGeoRowsWhere(*this, scope, alias, where))
+        return gen;
+
     auto comparison = dynamic_cast<const ComparisonExpression *>(&where);
 
     if (comparison) {
@@ -1872,6 +2278,15 @@ generateRowsWhere(const SqlBindingScope & scope,
         }
     }
 
+    // Ranges, IN lists and LIKE on a single column, which can be found from
+    // the values of the column rather than by reading each row
+    ColumnPath columnName;
+    if (getColumnConstraint(alias, where, columnName)) {
+        auto gen = generateColumnWhere(scope, alias, where, columnName);
+        if (gen)
+            return gen;
+    }
+
     // Where constant
     if (where.isConstant()) {
         if (where.constantValue().isTrue()) {
@@ -1962,84 +2377,76 @@ generateRowsWhere(const SqlBindingScope & scope,
                 //TODO - review if and how we should report progress here
                 auto rows = matrix->getRowPaths(start, limit);
 
-                std::vector<RowPath> rowsToKeep;
+                std::vector<RowPath> rowsToKeep
+                    = filterRowsWhere(*this, whereBound, needsColumns,
+                                      rows, params, onProgress);
 
-                PerThreadAccumulator<std::vector<RowPath> > accum;
+                start += rows.size();
+                Any newToken;
+                if (rows.size() == limit)
+                    newToken = start;
                 
-                size_t numRows = rows.size();
-                std::atomic_ulong rowCount(0);
-
-                ProgressState whereProgress(numRows);
-                auto onRow = [&] (size_t n)
-                    {
-                        ++rowCount;
-
-                        if (rowCount % PROGRESS_RATE == 0) {
-                            if (onProgress) {
-                                whereProgress = rowCount;
-                                if (!onProgress(whereProgress)) {
-                                    return false;
-                                }
-                            }
-                        }
-
-                        const RowPath & r = rows[n];
+                return make_pair(std::move(rowsToKeep),
+                                 std::move(newToken));
+            },
+            "scan table filtering by where expression"};
+}
 
-                        MatrixNamedRow row;
-                        if (needsColumns)
-                            row = matrix->getRow(r);
-                        else {
-                            row.rowHash = row.rowName = r;
-                        }
+GenerateRowsWhereFunction
+Dataset::
+generateColumnWhere(const SqlBindingScope & scope,
+                    const Utf8String & alias,
+                    const SqlExpression & where,
+                    const ColumnPath & columnName) const
+{
+    auto columnIndex = getColumnIndex();
 
-                        auto rowScope = dsScope.getRowScope(row, &params);
-                        
-                        bool keep = whereBound(rowScope, GET_LATEST).isTrue();
-                        
-                        if (keep)
-                            accum.get().push_back(r);
+    // Reading a variable also returns the structured columns under it,
+    // which the values in the column index don't include
+    for (auto & c: columnIndex->getColumnPaths()) {
+        if (c != columnName && c.startsWith(columnName))
+            return GenerateRowsWhereFunction();
+    }
 
-                        return true;
-                    };
+    SqlExpressionDatasetScope dsScope(*this, alias);
+    auto whereBound = where.bind(dsScope);
 
-                bool needSort = false;
-                if (rows.size() >= 1000) {
-                    // Scan the whole lot with the when in parallel
-                    if (!parallelMapHaltable(0, rows.size(), onRow))
-                        throw CancellationException("row where generation was cancelled");
-
-                    needSort = true;
-                } else {
-                    // Serial, since probably it's not worth the overhead
-                    // to run them in parallel.
-                    for (unsigned i = 0;  i < rows.size();  ++i)
-                        if (!onRow(i))
-                            throw CancellationException("row where generation was cancelled");
-                }
+    return {[=] (ssize_t numToGenerate, Any token,
+                 const BoundParameters & params,
+                 const ProgressFunc & onProgress)
+            -> std::pair<std::vector<RowPath>, Any>
+            {
+                auto columnIndex = this->getColumnIndex();
+                if (!columnIndex->knownColumn(columnName))
+                    return { {}, Any() };
 
-                // Now merge together the results of all the threads
-                auto onThreadOutput = [&] (std::vector<RowPath> * vec)
+                // Evaluate the where expression on a row with nothing but
+                // the value of the column
+                auto filter = [&] (const CellValue & val)
                     {
-                        rowsToKeep.insert(rowsToKeep.end(),
-                                          std::make_move_iterator(vec->begin()),
-                                          std::make_move_iterator(vec->end()));
+                        MatrixNamedRow row;
+                        row.columns.emplace_back(columnName, val,
+                                                 Date::negativeInfinity());
+                        auto rowScope
+                            = SqlExpressionDatasetScope::getRowScope(row,
+                                                                     &params);
+                        return whereBound(rowScope, GET_LATEST).isTrue();
                     };
-                
-                accum.forEach(onThreadOutput);
 
-                //Need sorting because the parallelisation breaks determinism
-                if (needSort) 
-                    parallelQuickSortRecursive<RowPath, SortByRowHash>(rowsToKeep.begin(), rowsToKeep.end());
+                std::vector<RowPath> rows;
+                for (auto & r: columnIndex->getColumnValues(columnName, filter))
+                    rows.emplace_back(std::move(std::get<0>(r)));
 
-                start += rows.size();
-                Any newToken;
-                if (rows.size() == limit)
-                    newToken = start;
-                
-                return make_pair(std::move(rowsToKeep),
-                                 std::move(newToken));
+                std::sort(rows.begin(), rows.end(), SortByRowHash());
+                rows.erase(std::unique(rows.begin(), rows.end()),
+                           rows.end());
+
+                return { std::move(rows), Any() };
             },
-            "scan table filtering by where expression"};
+            "generate rows from the values of column '"
+                + columnName.toUtf8String() + "' matching "
+                + where.print(),
+            GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
 }
 
 /**
@@ -2234,7 +2641,7 @@ queryBasic(const SqlBindingScope & scope,
             }
         };
 
-    return { exec };
+    return { exec, rowGenerator.explain.rawString() };
 }
 
 RestRequestMatchResult
@@ -2353,6 +2760,217 @@ void
 Dataset::
 commit()
 {
+    dataChanged();
+}
+
+uint64_t
+Dataset::
+getDataGeneration() const
+{
+    return dataGeneration_.load(std::memory_order_acquire);
+}
+
+uint64_t
+Dataset::
+saveCheckpoint(const Url & dataFileUrl)
+{
+    throw AnnotatedException(400, "Dataset type '" + getType()
+                             + "' doesn't support checkpoints",
+                             "datasetType", getType());
+}
+
+void
+Dataset::
+restoreCheckpoint(const std::vector<Url> & dataFileUrls)
+{
+    throw AnnotatedException(400, "Dataset type '" + getType()
+                             + "' doesn't support checkpoints",
+                             "datasetType", getType());
+}
+
+void
+Dataset::
+dataChanged()
+{
+    dataGeneration_.fetch_add(1, std::memory_order_acq_rel);
+}
+
+struct Dataset::GeoIndexCache {
+    struct Entry {
+        uint64_t generation;
+        std::shared_ptr<const GeoPointIndex> index;
+    };
+
+    std::mutex mutex;
+    std::map<std::pair<ColumnPath, ColumnPath>, Entry> entries;
+};
+
+Dataset::GeoIndexCachePtr::
+GeoIndexCachePtr()
+    : std::shared_ptr<GeoIndexCache>(std::make_shared<GeoIndexCache>())
+{
+}
+
+Dataset::GeoIndexCachePtr::
+GeoIndexCachePtr(const GeoIndexCachePtr & other)
+    : GeoIndexCachePtr()
+{
+}
+
+Dataset::GeoIndexCachePtr &
+Dataset::GeoIndexCachePtr::
+operator = (const GeoIndexCachePtr & other)
+{
+    return *this;
+}
+
+/** Build the geo point index of the dataset over the given columns, or
+    return null if they can't be indexed.
+*/
+static std::shared_ptr<const GeoPointIndex>
+buildGeoPointIndex(const Dataset & dataset,
+                   const ColumnPath & latitude,
+                   const ColumnPath & longitude)
+{
+    auto columnIndex = dataset.getColumnIndex();
+    if (!columnIndex->knownColumn(latitude)
+        || !columnIndex->knownColumn(longitude))
+        return nullptr;
+
+    // Reading a variable also returns the structured columns under it,
+    // which the values in the column index don't include
+    for (auto & c: columnIndex->getColumnPaths()) {
+        if ((c != latitude && c.startsWith(latitude))
+            || (c != longitude && c.startsWith(longitude)))
+            return nullptr;
+    }
+
+    auto latValues = columnIndex->getColumnValues(latitude);
+    auto lonValues = columnIndex->getColumnValues(longitude);
+
+    struct Entry {
+        RowHash hash;
+        uint32_t index;
+        bool operator < (const Entry & other) const
+        {
+            return hash < other.hash
+                || (hash == other.hash && index < other.index);
+        }
+    };
+
+    // Return the numeric values sorted by row hash, or false if there
+    // is one that's not a number
+    auto sortValues = [] (const std::vector<std::tuple<RowPath, CellValue> > & values,
+                          std::vector<Entry> & entries)
+        {
+            entries.reserve(values.size());
+            for (uint32_t i = 0;  i < values.size();  ++i) {
+                const CellValue & val = std::get<1>(values[i]);
+                if (val.empty())
+                    continue;
+                if (!val.isNumber())
+                    return false;
+                entries.push_back({ RowHash(std::get<0>(values[i])), i });
+            }
+            std::sort(entries.begin(), entries.end());
+            return true;
+        };
+
+    std::vector<Entry> latEntries, lonEntries;
+    if (!sortValues(latValues, latEntries)
+        || !sortValues(lonValues, lonEntries))
+        return nullptr;
+
+    // Join the two columns by row, with a point for each combination of
+    // values of the same row
+    std::vector<RowPath> rows;
+    std::vector<GeoPointIndex::Point> points;
+
+    auto latIt = latEntries.begin(), latEnd = latEntries.end();
+    auto lonIt = lonEntries.begin(), lonEnd = lonEntries.end();
+
+    while (latIt != latEnd && lonIt != lonEnd) {
+        if (latIt->hash < lonIt->hash) {
+            ++latIt;
+            continue;
+        }
+        if (lonIt->hash < latIt->hash) {
+            ++lonIt;
+            continue;
+        }
+
+        RowHash hash = latIt->hash;
+        auto latRunEnd = latIt, lonRunEnd = lonIt;
+        while (latRunEnd != latEnd && latRunEnd->hash == hash)
+            ++latRunEnd;
+        while (lonRunEnd != lonEnd && lonRunEnd->hash == hash)
+            ++lonRunEnd;
+
+        // The rows of a run almost always have the same path, but may not
+        // if their hashes collide
+        size_t firstRow = rows.size();
+        for (auto lat = latIt;  lat != latRunEnd;  ++lat) {
+            const RowPath & row = std::get<0>(latValues[lat->index]);
+            for (auto lon = lonIt;  lon != lonRunEnd;  ++lon) {
+                if (std::get<0>(lonValues[lon->index]) != row)
+                    continue;
+                size_t rowNum = firstRow;
+                while (rowNum < rows.size() && rows[rowNum] != row)
+                    ++rowNum;
+                if (rowNum == rows.size())
+                    rows.push_back(row);
+                points.push_back
+                    ({ std::get<1>(latValues[lat->index]).toDouble(),
+                       std::get<1>(lonValues[lon->index]).toDouble(),
+                       (uint32_t)rowNum });
+            }
+        }
+
+        latIt = latRunEnd;
+        lonIt = lonRunEnd;
+    }
+
+    return std::make_shared<GeoPointIndex>(std::move(rows), std::move(points));
+}
+
+std::shared_ptr<const GeoPointIndex>
+Dataset::
+getGeoPointIndex(const ColumnPath & latitude,
+                 const ColumnPath & longitude) const
+{
+    uint64_t generation = getDataGeneration();
+    auto key = std::make_pair(latitude, longitude);
+
+    GeoIndexCache & cache = *geoIndexCache_;
+    std::unique_lock<std::mutex> guard(cache.mutex);
+
+    auto it = cache.entries.find(key);
+    if (it != cache.entries.end() && it->second.generation == generation)
+        return it->second.index;
+
+    // Built under the lock, so that queries arriving at the same time
+    // don't all build it
+    auto index = buildGeoPointIndex(*this, latitude, longitude);
+    cache.entries[key] = { generation, index };
+    return index;
+}
+
+std::vector<std::shared_ptr<Dataset> >
+Dataset::
+getAggregationPartitions() const
+{
+    return {};
+}
+
+bool
+Dataset::
+pushdownAggregators(const Utf8String & alias,
+                    const SqlExpression & where,
+                    const std::vector<std::shared_ptr<SqlExpression> > & aggregators,
+                    std::vector<ExpressionValue> & results,
+                    uint64_t & numRows) const
+{
+    return false;
 }
 
 BoundFunction
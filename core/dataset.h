@@ -16,6 +16,7 @@
 #include "mldb/core/recorder.h"
 #include "mldb/utils/progress.h"
 #include <set>
+#include <atomic>
 
 // NOTE TO MLDB DEVELOPERS: This is an API header file.  No includes
 // should be added, especially value_description.h.
@@ -39,8 +40,11 @@ struct TupleExpression;
 struct WhenExpression;
 struct RowValueInfo;
 struct ExpressionValue;
+struct UnboundEntities;
 struct BucketList;
 struct BucketDescriptions;
+struct SqlBatchVector;
+struct GeoPointIndex;
 
 typedef EntityType<Dataset> DatasetType;
 
@@ -335,7 +339,22 @@ struct RowStream {
     extractNumbers(size_t numRows,
                    const std::vector<ColumnPath> & columnNames,
                    double * output);
-    
+
+    /** Extract the given set of columns for the given stream,
+        a column at a time, for numRows rows.  output[i] is filled
+        in with the values of columnNames[i], in typed arrays
+        where possible, so that expressions can be executed over
+        them in batch mode (see sql_batch.h).
+
+        Any column that is not present will fill in nulls.
+
+        It will also advance the rowStream by n rows.  The default
+        implementation calls extractColumns().
+    */
+    virtual void
+    extractColumnBatches(size_t numRows,
+                         const std::vector<ColumnPath> & columnNames,
+                         SqlBatchVector * output);
 };
 
 
@@ -523,6 +542,18 @@ struct Dataset: public MldbEntity {
     */
     virtual ExpressionValue getRowExpr(const RowPath & row) const;
 
+    /** Return a function that returns a row as an expression value, like
+        getRowExpr(), but that only needs to include the columns that an
+        expression with the given unbound entities, bound with the given
+        alias, could read.  This allows datasets that store their values
+        by column to avoid decoding the columns that a query doesn't use.
+
+        Default returns a function that calls getRowExpr().
+    */
+    virtual std::function<ExpressionValue (const RowPath & row)>
+    getRowExprProjection(const UnboundEntities & unbound,
+                         const Utf8String & alias) const;
+
 
     /** Commit changes to the database.  Default is a no-op.
 
@@ -533,6 +564,69 @@ struct Dataset: public MldbEntity {
     */
     virtual void commit();
 
+    /** Return a number that changes whenever rows are recorded in or
+        committed to this dataset, so that something computed from its
+        contents (such as a cached query result) can tell when it's out
+        of date.  Dataset types whose contents change without going
+        through recordRow() or the default commit() must call
+        dataChanged() when they do.
+    */
+    virtual uint64_t getDataGeneration() const;
+
+    /** Note that the contents of the dataset have changed, so that
+        getDataGeneration() returns a new value.
+    */
+    void dataChanged();
+
+    /** Commit, then save the rows committed since the last call (or since
+        the dataset was created) to the given file, so that a procedure
+        that is writing the dataset can later be resumed from this point.
+        Returns the number of rows that were saved.
+
+        Default throws, as most dataset types can't do it.
+    */
+    virtual uint64_t saveCheckpoint(const Url & dataFileUrl);
+
+    /** Append the rows of files written by saveCheckpoint(), in the order
+        they were written, to a dataset that nothing has been recorded to,
+        which brings it back to where it was at the last of them.
+
+        Default throws, as most dataset types can't do it.
+    */
+    virtual void restoreCheckpoint(const std::vector<Url> & dataFileUrls);
+
+    /** Return datasets which between them hold the rows of this one, with
+        each row in only one of them, or an empty list if the dataset
+        isn't made up that way.  A GROUP BY query over the dataset
+        aggregates each of them separately and merges the results, and
+        keeps the aggregates of each one until its data generation
+        changes, so that a repeated query only has to aggregate the
+        datasets that changed.
+    */
+    virtual std::vector<std::shared_ptr<Dataset> >
+    getAggregationPartitions() const;
+
+    /** Allow the dataset to calculate the aggregators of a query without
+        GROUP BY itself, for example by having the database that holds its
+        rows run the aggregation, so that the rows never need to be read.
+        This is "aggregate pushdown".
+
+        The aggregators are function calls such as count(*), count(x) or
+        max(x), and where is the query's WHERE clause.  On success, results
+        holds the value of each aggregator in the same order, and numRows
+        the number of rows that matched the where clause.  The results
+        must be the same as what aggregating the rows would give.
+
+        Returns false if the dataset can't calculate all of them, which
+        is what the default implementation does.
+    */
+    virtual bool
+    pushdownAggregators(const Utf8String & alias,
+                        const SqlExpression & where,
+                        const std::vector<std::shared_ptr<SqlExpression> > & aggregators,
+                        std::vector<ExpressionValue> & results,
+                        uint64_t & numRows) const;
+
     /** Select from the database. */
     virtual std::vector<MatrixNamedRow>
     queryStructured(const SelectExpression & select,
@@ -650,6 +744,45 @@ struct Dataset: public MldbEntity {
                       ssize_t offset,
                       ssize_t limit) const;
 
+    /** Return a function that generates the rows matching a where
+        expression that only constrains the value of one column, such as
+        x BETWEEN 1 AND 10, x IN ('a', 'b'), x LIKE 'abc%' or a conjunction
+        of these.  The expression is false for rows where the column is
+        null, so they never need to be looked at.
+
+        Returns a null function to have generateRowsWhere() fall back to
+        its other methods.  The default implementation evaluates the
+        expression on each of the values of the column from
+        getColumnIndex(), which like the other lookups from the column
+        index considers all values of the column and not just the latest
+        one.  Datasets with a better way of skipping rows, like zone maps,
+        can return a null function to get a table scan instead.
+    */
+    virtual GenerateRowsWhereFunction
+    generateColumnWhere(const SqlBindingScope & context,
+                        const Utf8String & alias,
+                        const SqlExpression & where,
+                        const ColumnPath & columnName) const;
+
+    /** Return an index of the rows of the dataset by the point whose
+        latitude and longitude (in degrees) are the values of the given
+        columns, which generateRowsWhere() uses to find the rows for which
+        geo_distance(latitude, longitude, ...) is below a limit or
+        ST_Contains_Point(..., latitude, longitude) is true.  Like the
+        other lookups from the column index it considers all values of the
+        columns, so a row with several values of either has a point for
+        each combination of them.
+
+        Returns null to have the rows scanned instead, which happens when
+        either column is unknown, is structured or has a value that isn't
+        a number.  The default implementation builds the index from
+        getColumnIndex() the first time it's needed, and keeps it until
+        the data generation of the dataset changes.
+    */
+    virtual std::shared_ptr<const GeoPointIndex>
+    getGeoPointIndex(const ColumnPath & latitude,
+                     const ColumnPath & longitude) const;
+
     /** Perform the guts of a select statement.  This will perform a single-
         table SELECT, with the given WHERE clause, ORDER BY, offset and limit.
         
@@ -724,6 +857,39 @@ struct Dataset: public MldbEntity {
                                        const RowPath & name) const;
 
     virtual uint64_t getRowCount() const;
+
+private:
+    /// Atomic counter that can be copied along with the dataset
+    struct Generation: public std::atomic<uint64_t> {
+        Generation()
+            : std::atomic<uint64_t>(0)
+        {
+        }
+
+        Generation(const Generation & other)
+            : std::atomic<uint64_t>(other.load())
+        {
+        }
+
+        Generation & operator = (const Generation & other)
+        {
+            store(other.load());
+            return *this;
+        }
+    };
+
+    Generation dataGeneration_;
+
+    /// Geo point indexes built by getGeoPointIndex().  Copies of the
+    /// dataset start with an empty cache.
+    struct GeoIndexCache;
+    struct GeoIndexCachePtr: public std::shared_ptr<GeoIndexCache> {
+        GeoIndexCachePtr();
+        GeoIndexCachePtr(const GeoIndexCachePtr & other);
+        GeoIndexCachePtr & operator = (const GeoIndexCachePtr & other);
+    };
+
+    GeoIndexCachePtr geoIndexCache_;
 };
 
 
@@ -757,6 +923,17 @@ createDataset(MldbEngine * engine,
               = nullptr,
               bool overwrite = false);
 
+/** Return a generator that produces the rows of gen for which filter is
+    true, reading each of them with getRowExpr() if the filter needs its
+    columns.  This allows a dataset that can only find a superset of the
+    rows matching a where clause to check the rest itself.
+*/
+GenerateRowsWhereFunction
+generateFilteredRows(const Dataset & dataset,
+                     const Utf8String & alias,
+                     GenerateRowsWhereFunction gen,
+                     const SqlExpression & filter);
+
 
 DECLARE_STRUCTURE_DESCRIPTION_NAMED(DatasetPolyConfigDescription, PolyConfigT<Dataset>);
 DECLARE_STRUCTURE_DESCRIPTION_NAMED(ConstDatasetPolyConfigDescription, PolyConfigT<const Dataset>);
@@ -16,6 +16,8 @@
 #include "mldb/types/map_description.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/rest/rest_request_router.h"
+#include "mldb/utils/lru_cache.h"
+#include <atomic>
 
 
 using namespace std;
@@ -77,6 +79,14 @@ FunctionPolyConfigDescription()
              " even if the arguments are not row-dependent. If true, then it is assumed for optimization purposes "
              " that calling the function with the same input will always return the same value for a single SQL query"
              , false);
+    addField("cacheSize", &PolyConfig::cacheSize,
+             "Number of outputs of the function to memoize, keyed by its "
+             "input, so that calling it again with the same input returns "
+             "the cached output instead of recomputing it.  This must only "
+             "be used for functions whose output depends on nothing but "
+             "their input.  0 disables the cache, and -1 (the default) uses "
+             "the default for the function type, which is 0 for most types.",
+             (int64_t)-1);
 
     setTypeName("FunctionConfig");
     documentationUri = "/doc/builtin/functions/FunctionConfig.md";
@@ -107,6 +117,92 @@ checkInputCompatibility(const std::vector<std::shared_ptr<ExpressionValueInfo> >
 }
 
 
+/*****************************************************************************/
+/* FUNCTION CACHE                                                            */
+/*****************************************************************************/
+
+/** Memoized outputs of a function, keyed by the hash of the input.  The
+    input is kept with the output and compared on lookup, so a hash
+    collision is a miss rather than a wrong answer.
+
+    Input values are compared without their timestamps.  When a cached
+    output is used for an input with a different timestamp, it's only
+    valid if the output's timestamps come from the input's; so outputs
+    all stamped with the effective timestamp of their input are restamped
+    with that of the new input, and any other output is only used for
+    inputs with the same timestamp.
+*/
+struct FunctionCache {
+    FunctionCache(size_t capacity)
+        : entries(capacity)
+    {
+    }
+
+    struct Entry {
+        ExpressionValue input;
+        ExpressionValue output;
+        bool followsInput;    ///< All output timestamps are the input's
+    };
+
+    ShardedLruCache<uint64_t, std::shared_ptr<const Entry> > entries;
+    std::atomic<uint64_t> hits{0}, misses{0};
+
+    static ExpressionValue restamp(const ExpressionValue & val, Date ts)
+    {
+        if (val.isRow() && !val.isEmbedding()) {
+            StructValue result;
+            auto onColumn = [&] (const PathElement & column,
+                                 const ExpressionValue & val)
+                {
+                    result.emplace_back(column, restamp(val, ts));
+                    return true;
+                };
+            val.forEachColumn(onColumn);
+            ExpressionValue row(std::move(result));
+            row.setEffectiveTimestamp(ts);
+            return row;
+        }
+
+        ExpressionValue result = val;
+        result.setEffectiveTimestamp(ts);
+        return result;
+    }
+
+    bool get(uint64_t hash, const ExpressionValue & input,
+             ExpressionValue & output)
+    {
+        std::shared_ptr<const Entry> entry;
+        if (entries.get(hash, entry) && entry->input == input) {
+            Date ts = input.getEffectiveTimestamp();
+            if (ts == entry->input.getEffectiveTimestamp()) {
+                output = entry->output;
+                ++hits;
+                return true;
+            }
+            if (entry->followsInput) {
+                output = restamp(entry->output, ts);
+                ++hits;
+                return true;
+            }
+        }
+        ++misses;
+        return false;
+    }
+
+    void put(uint64_t hash, const ExpressionValue & input,
+             const ExpressionValue & output)
+    {
+        auto entry = std::make_shared<Entry>();
+        entry->input = input;
+        entry->output = output;
+        Date ts = input.getEffectiveTimestamp();
+        entry->followsInput = output.getMinTimestamp() == ts
+            && output.getMaxTimestamp() == ts;
+        entries.put(hash, std::move(entry));
+    }
+};
+
+
 /*****************************************************************************/
 /* FUNCTION APPLIER                                                          */
 /*****************************************************************************/
@@ -116,7 +212,55 @@ FunctionApplier::
 apply(const ExpressionValue & input) const
 { 
     ExcAssert(function);
-    return function->apply(*this, input);
+    FunctionCache * cache = function->cache_.get();
+    if (!cache)
+        return function->apply(*this, input);
+
+    uint64_t hash = input.hash();
+    ExpressionValue result;
+    if (!cache->get(hash, input, result)) {
+        result = function->apply(*this, input);
+        cache->put(hash, input, result);
+    }
+    return result;
+}
+
+std::vector<ExpressionValue>
+FunctionApplier::
+applyBatch(const std::vector<ExpressionValue> & inputs) const
+{
+    ExcAssert(function);
+    FunctionCache * cache = function->cache_.get();
+    if (!cache)
+        return function->applyBatch(*this, inputs);
+
+    // Only the inputs that aren't cached go to the function
+    std::vector<ExpressionValue> result(inputs.size());
+    std::vector<uint64_t> hashes(inputs.size());
+    std::vector<size_t> missed;
+    std::vector<ExpressionValue> missedInputs;
+    for (size_t i = 0;  i < inputs.size();  ++i) {
+        hashes[i] = inputs[i].hash();
+        if (!cache->get(hashes[i], inputs[i], result[i])) {
+            missed.push_back(i);
+            missedInputs.push_back(inputs[i]);
+        }
+    }
+
+    if (missed.empty())
+        return result;
+
+    std::vector<ExpressionValue> outputs
+        = function->applyBatch(*this, missedInputs);
+    ExcAssertEqual(outputs.size(), missed.size());
+
+    for (size_t j = 0;  j < missed.size();  ++j) {
+        size_t i = missed[j];
+        cache->put(hashes[i], inputs[i], outputs[j]);
+        result[i] = std::move(outputs[j]);
+    }
+
+    return result;
 }
 
 
@@ -129,6 +273,36 @@ Function(MldbEngine * engine, const PolyConfig& config)
     : engine(engine)
 {
     config_ = make_shared<PolyConfig>(config);
+    if (config.cacheSize > 0)
+        cache_ = std::make_shared<FunctionCache>(config.cacheSize);
+}
+
+void
+Function::
+setDefaultCacheSize(size_t size)
+{
+    if (config_->cacheSize < 0 && size > 0)
+        cache_ = std::make_shared<FunctionCache>(size);
+}
+
+Json::Value
+Function::
+getCacheStats() const
+{
+    Json::Value result;
+    result["enabled"] = !!cache_;
+    if (!cache_)
+        return result;
+
+    LruCacheStats stats = cache_->entries.stats();
+    uint64_t hits = cache_->hits, misses = cache_->misses;
+    result["size"] = stats.size;
+    result["capacity"] = stats.capacity;
+    result["evictions"] = stats.evictions;
+    result["hits"] = hits;
+    result["misses"] = misses;
+    result["hitRate"] = hits + misses ? 1.0 * hits / (hits + misses) : 0.0;
+    return result;
 }
 
 Function::
@@ -174,6 +348,18 @@ getFunctionInfo() const
                         + " needs to override getFunctionInfo()");
 }
 
+std::vector<ExpressionValue>
+Function::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    std::vector<ExpressionValue> result;
+    result.reserve(inputs.size());
+    for (auto & input: inputs)
+        result.emplace_back(apply(applier, input));
+    return result;
+}
+
 RestRequestMatchResult
 Function::
 handleRequest(RestConnection & connection,
@@ -28,6 +28,7 @@
 namespace MLDB {
 
 struct Function;
+struct FunctionCache;
 struct MldbEngine;
 struct SqlExpression;
 struct SqlRowExpression;
@@ -116,6 +117,10 @@ struct FunctionApplier {
 
     /// Apply the function to the given context
     ExpressionValue apply(const ExpressionValue & input) const;
+
+    /// Apply the function to each of the given contexts
+    std::vector<ExpressionValue>
+    applyBatch(const std::vector<ExpressionValue> & inputs) const;
 };
 
 
@@ -206,6 +211,32 @@ struct Function: public MldbEntity {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                                   const ExpressionValue & context) const = 0;
 
+    /** Apply the function to many inputs at once, returning one output
+        per input.  The default calls apply() on each; functions whose
+        per-call overhead can be shared over a batch should override it.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const;
+
+    /** Return statistics about the cache of outputs (see the cacheSize
+        field of the function's configuration): whether it's enabled, its
+        size and capacity, and its hits, misses and hit rate.
+    */
+    Json::Value getCacheStats() const;
+
+protected:
+    /** Set the number of outputs to memoize when the configuration
+        doesn't say (its cacheSize is -1).  Function types whose output
+        depends on nothing but their input, and that are expensive relative
+        to a hash table lookup, call this from their constructor.
+    */
+    void setDefaultCacheSize(size_t size);
+
+private:
+    /// Memoized outputs, or null if the function isn't cached
+    std::shared_ptr<FunctionCache> cache_;
+
     friend class FunctionApplier;
 };
 
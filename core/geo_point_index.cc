@@ -0,0 +1,176 @@
+/** geo_point_index.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Index of the rows of a dataset by a latitude and longitude.
+*/
+
+#include "mldb/core/geo_point_index.h"
+#include "mldb/base/parallel_merge_sort.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
+#include <cmath>
+
+
+namespace MLDB {
+
+namespace {
+
+/// Quantize a value in [low, high] to 32 bits
+uint32_t quantize(double val, double low, double high)
+{
+    double scaled = (val - low) / (high - low) * 4294967296.0;
+    if (!(scaled > 0))
+        return 0;
+    if (scaled >= 4294967295.0)
+        return 4294967295U;
+    return (uint32_t)scaled;
+}
+
+/// Spread the bits of a 32 bit number out to the even bits of 64
+uint64_t spreadBits(uint32_t x)
+{
+    uint64_t v = x;
+    v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+    v = (v | (v << 8))  & 0x00ff00ff00ff00ffULL;
+    v = (v | (v << 4))  & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | (v << 2))  & 0x3333333333333333ULL;
+    v = (v | (v << 1))  & 0x5555555555555555ULL;
+    return v;
+}
+
+/// Normalize a point in the same way as S2LatLng::Normalized()
+void normalize(double & lat, double & lon)
+{
+    lat = std::max(-90.0, std::min(90.0, lat));
+    lon = std::remainder(lon, 360.0);
+}
+
+} // file scope
+
+GeoPointIndex::
+GeoPointIndex(std::vector<RowPath> rows_, std::vector<Point> points_)
+    : rows(std::move(rows_))
+{
+    struct Entry {
+        uint64_t code;
+        Point point;
+        bool operator < (const Entry & other) const
+        {
+            return code < other.code
+                || (code == other.code && point.row < other.point.row);
+        }
+    };
+
+    std::vector<Entry> entries;
+    entries.reserve(points_.size());
+    for (auto & p: points_) {
+        ExcAssertLess(p.row, rows.size());
+        normalize(p.lat, p.lon);
+        if (!std::isfinite(p.lat) || !std::isfinite(p.lon))
+            continue;
+        entries.push_back({ geohash(p.lat, p.lon), p });
+    }
+    points_.clear();  points_.shrink_to_fit();
+
+    parallelQuickSortRecursive<Entry, std::less<Entry> >
+        (entries.begin(), entries.end());
+
+    codes.reserve(entries.size());
+    points.reserve(entries.size());
+    for (auto & e: entries) {
+        codes.push_back(e.code);
+        points.push_back(e.point);
+    }
+}
+
+uint64_t
+GeoPointIndex::
+geohash(double lat, double lon)
+{
+    return spreadBits(quantize(lon, -180, 180))
+        | (spreadBits(quantize(lat, -90, 90)) << 1);
+}
+
+std::vector<RowPath>
+GeoPointIndex::
+findRows(const GeoBoundingBox & box) const
+{
+    std::vector<uint32_t> found;
+    if (box.empty)
+        return {};
+
+    if (box.minLon <= box.maxLon) {
+        findInBox(box.minLat, box.maxLat, box.minLon, box.maxLon, found);
+    }
+    else {
+        // Crosses the antimeridian
+        findInBox(box.minLat, box.maxLat, box.minLon, 180, found);
+        findInBox(box.minLat, box.maxLat, -180, box.maxLon, found);
+    }
+
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+
+    std::vector<RowPath> result;
+    result.reserve(found.size());
+    for (auto & r: found)
+        result.push_back(rows[r]);
+    return result;
+}
+
+void
+GeoPointIndex::
+findInBox(double minLat, double maxLat, double minLon, double maxLon,
+          std::vector<uint32_t> & found) const
+{
+    if (codes.empty() || minLat > maxLat || minLon > maxLon)
+        return;
+
+    uint32_t qMinLat = quantize(minLat, -90, 90);
+    uint32_t qMaxLat = quantize(maxLat, -90, 90);
+    uint32_t qMinLon = quantize(minLon, -180, 180);
+    uint32_t qMaxLon = quantize(maxLon, -180, 180);
+
+    // Number of low bits of each coordinate to drop to get cells that are
+    // at least as big as the box, so that it touches at most two of them
+    // in each direction
+    auto bitsFor = [] (uint32_t low, uint32_t high) -> int
+        {
+            uint64_t span = uint64_t(high) - low;
+            return span == 0 ? 0 : 64 - __builtin_clzll(span);
+        };
+    int shift = std::max(bitsFor(qMinLat, qMaxLat), bitsFor(qMinLon, qMaxLon));
+
+    auto cells = [&] (uint32_t low, uint32_t high)
+        {
+            uint64_t first = shift == 32 ? 0 : low >> shift;
+            uint64_t last = shift == 32 ? 0 : high >> shift;
+            return std::make_pair(first, last);
+        };
+
+    auto latCells = cells(qMinLat, qMaxLat);
+    auto lonCells = cells(qMinLon, qMaxLon);
+
+    for (uint64_t latCell = latCells.first;  latCell <= latCells.second;
+         ++latCell) {
+        for (uint64_t lonCell = lonCells.first;  lonCell <= lonCells.second;
+             ++lonCell) {
+            // The geohashes in a cell are a contiguous range
+            uint64_t prefix = spreadBits(lonCell) | (spreadBits(latCell) << 1);
+            uint64_t begin = shift == 32 ? 0 : prefix << (2 * shift);
+            uint64_t last = shift == 32
+                ? ~uint64_t(0)
+                : begin + ((uint64_t(1) << (2 * shift)) - 1);
+
+            auto first = std::lower_bound(codes.begin(), codes.end(), begin);
+            for (auto it = first;  it != codes.end() && *it <= last;  ++it) {
+                const Point & p = points[it - codes.begin()];
+                if (p.lat >= minLat && p.lat <= maxLat
+                    && p.lon >= minLon && p.lon <= maxLon)
+                    found.push_back(p.row);
+            }
+        }
+    }
+}
+
+} // namespace MLDB
@@ -0,0 +1,75 @@
+/** geo_point_index.h                                               -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Index of the rows of a dataset by a latitude and longitude.
+*/
+
+#pragma once
+
+#include "mldb/sql/dataset_types.h"
+#include "mldb/sql/builtin_geo_functions.h"
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* GEO POINT INDEX                                                           */
+/*****************************************************************************/
+
+/** Immutable index of rows by a point given as latitude and longitude in
+    degrees, which finds the rows whose point is in a bounding box without
+    looking at the others.
+
+    Each point is given the geohash of its position, that is the bits of
+    its latitude and longitude quantized to 32 bits each and interleaved,
+    and the points are sorted by it.  The points in any geohash cell are
+    then next to each other.  A box is looked up by covering it with at
+    most four cells that are at least as big as it in each direction, and
+    binary searching for each of them.
+
+    Points are normalized the same way as by the geo functions: latitudes
+    are clamped to [-90, 90] and longitudes wrapped into [-180, 180].
+*/
+
+struct GeoPointIndex {
+
+    struct Point {
+        double lat;
+        double lon;
+        uint32_t row;   ///< Index of the row in the rows passed in
+    };
+
+    /** Build the index.  A row may have more than one point.  Points
+        whose longitude isn't finite are left out.
+    */
+    GeoPointIndex(std::vector<RowPath> rows, std::vector<Point> points);
+
+    /** Return the rows with a point in the box, each only once, in a
+        deterministic order.
+    */
+    std::vector<RowPath> findRows(const GeoBoundingBox & box) const;
+
+    /// Number of points indexed
+    size_t numPoints() const { return codes.size(); }
+
+    /// Number of rows the index was built for
+    size_t numRows() const { return rows.size(); }
+
+    /// Geohash of a normalized point, as used to sort them
+    static uint64_t geohash(double lat, double lon);
+
+private:
+    std::vector<RowPath> rows;
+
+    // These are all in order of geohash
+    std::vector<uint64_t> codes;
+    std::vector<Point> points;
+
+    /// Add the rows of the points in the box, which mustn't wrap
+    void findInBox(double minLat, double maxLat, double minLon, double maxLon,
+                   std::vector<uint32_t> & found) const;
+};
+
+} // namespace MLDB
@@ -194,6 +194,13 @@ struct MldbEngine {
     
     virtual std::shared_ptr<Sensor>
     getSensor(const Utf8String & sensorName) const = 0;
+
+    /** Return a number that changes whenever a dataset or function is
+        created, replaced or deleted.  Anything that refers to those
+        entities by name, such as a bound query, can record it to know
+        when it needs to be bound again.
+    */
+    virtual uint64_t getCatalogGeneration() const = 0;
 };
 
 } // namespace MLDB
@@ -23,6 +23,17 @@ getOwner(RestDirectory * peer)
     return result;
 }
 
+std::string
+MldbEntity::
+getMetricsType() const
+{
+    if (config_ && !config_->type.empty())
+        return config_->type.rawString();
+    if (!type_.empty())
+        return type_.rawString();
+    return "internal";
+}
+
 /*****************************************************************************/
 /* UTILITY FUNCTIONS                                                         */
 /*****************************************************************************/
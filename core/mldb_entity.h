@@ -56,6 +56,12 @@ struct MldbEntity: public PolyEntity {
     {
         return peer;
     }
+
+    /** Return the type of the entity to label its metrics with.  Entities
+        that were created internally, like the datasets inside a query,
+        may have no configuration and are labeled "internal".
+    */
+    std::string getMetricsType() const;
     
     static constexpr const char * INTERNAL_ENTITY  = "INTERNAL_ENTITY";
     std::shared_ptr<spdlog::logger> logger;
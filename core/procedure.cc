@@ -9,9 +9,17 @@
 #include "mldb/core/procedure.h"
 #include "mldb/core/mldb_engine.h"
 #include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/enum_description.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/memory_arena.h"
+#include "mldb/base/resource_usage.h"
+#include "mldb/types/map_description.h"
 #include <mutex>
+#include <cmath>
 #include "mldb/types/any_impl.h"
 #include "mldb/rest/cancellation_exception.h"
+#include "mldb/rest/latency_metrics.h"
 
 
 using namespace std;
@@ -42,6 +50,56 @@ createProcedure(MldbEngine * engine,
 /* PROCEDURE TRAINING                                                         */
 /*****************************************************************************/
 
+DEFINE_ENUM_DESCRIPTION(ParallelPriority);
+
+ParallelPriorityDescription::
+ParallelPriorityDescription()
+{
+    addValue("interactive", ParallelPriority::INTERACTIVE,
+             "Latency sensitive work, which is given priority for the CPUs");
+    addValue("batch", ParallelPriority::BATCH,
+             "Throughput oriented work, which gives up part of the CPUs "
+             "while interactive work is running");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(ProcedureRunResources);
+
+ProcedureRunResourcesDescription::
+ProcedureRunResourcesDescription()
+{
+    addField("cpus", &ProcedureRunResources::cpus,
+             "Number of CPUs that the run keeps busy.  Unless "
+             "maxParallelism is set, the run is also limited to that many "
+             "threads.  The default of 0 reserves nothing.", 0.0);
+    addField("memoryBytes", &ProcedureRunResources::memoryBytes,
+             "Bytes of memory that the run needs.  The default of 0 "
+             "reserves nothing.", (uint64_t)0);
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(ProcedureRunCheckpointConfig);
+
+ProcedureRunCheckpointConfigDescription::
+ProcedureRunCheckpointConfigDescription()
+{
+    addField("url", &ProcedureRunCheckpointConfig::url,
+             "Directory in which the run saves checkpoints of its progress.  "
+             "The default of an empty string saves none.");
+    addField("intervalSeconds", &ProcedureRunCheckpointConfig::intervalSeconds,
+             "Number of seconds between checkpoints.", 300.0);
+    addField("resume", &ProcedureRunCheckpointConfig::resume,
+             "If true, the run continues from the last checkpoint in the "
+             "directory, if there is one.  If false, any checkpoints "
+             "already there are removed and the run starts from the "
+             "beginning.", false);
+}
+
+ProcedureRunConfig::
+ProcedureRunConfig()
+    : maxParallelism(-1), priority(ParallelPriority::BATCH),
+      queuePriority(0)
+{
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(ProcedureRunConfig);
 
 ProcedureRunConfigDescription::
@@ -51,6 +109,81 @@ ProcedureRunConfigDescription()
 
     addField("id", &ProcedureRunConfig::id, "ID of run");
     addField("params", &ProcedureRunConfig::params, "Parameters of run");
+    addField("maxParallelism", &ProcedureRunConfig::maxParallelism,
+             "Maximum number of threads that the run may use at once.  The "
+             "default of -1 means as many as there are CPUs.", -1);
+    addField("priority", &ProcedureRunConfig::priority,
+             "Priority of the run.  Batch runs give up part of the CPUs "
+             "while interactive queries are running, so as not to slow "
+             "them down.", ParallelPriority::BATCH);
+    addField("resources", &ProcedureRunConfig::resources,
+             "CPUs and memory that the run reserves while it executes.  A "
+             "run waits in a queue until the procedure run limits of the "
+             "server leave enough of them for it.");
+    addField("queuePriority", &ProcedureRunConfig::queuePriority,
+             "Priority of the run in the queue of runs waiting to start.  "
+             "Runs with a higher priority start first; runs of the same "
+             "priority start in the order they were submitted.", 0);
+    addField("checkpoint", &ProcedureRunConfig::checkpoint,
+             "Checkpoints of the progress of the run, which allow it to be "
+             "resumed after a failure or a restart.  Only some procedures "
+             "save checkpoints.");
+
+    onPostValidate = [] (ProcedureRunConfig * config,
+                         JsonParsingContext & context)
+        {
+            if (config->maxParallelism != -1 && config->maxParallelism < 1)
+                throw AnnotatedException
+                    (400, "maxParallelism of a procedure run must be -1 or "
+                     "at least 1",
+                     "maxParallelism", config->maxParallelism);
+            if (config->resources.cpus < 0)
+                throw AnnotatedException
+                    (400, "resources.cpus of a procedure run must not be "
+                     "negative",
+                     "cpus", config->resources.cpus);
+            if (config->checkpoint.intervalSeconds <= 0)
+                throw AnnotatedException
+                    (400, "checkpoint.intervalSeconds of a procedure run "
+                     "must be positive",
+                     "intervalSeconds", config->checkpoint.intervalSeconds);
+        };
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(MemoryArenaStats);
+
+MemoryArenaStatsDescription::
+MemoryArenaStatsDescription()
+{
+    addField("bytesInUse", &MemoryArenaStats::bytesInUse,
+             "Bytes allocated from the arena and not yet freed");
+    addField("peakBytesInUse", &MemoryArenaStats::peakBytesInUse,
+             "Most bytes allocated from the arena at once");
+    addField("bytesReserved", &MemoryArenaStats::bytesReserved,
+             "Bytes the arena holds from the operating system");
+    addField("peakBytesReserved", &MemoryArenaStats::peakBytesReserved,
+             "Most bytes the arena held from the operating system at once");
+    addField("numAllocations", &MemoryArenaStats::numAllocations,
+             "Number of allocations made from the arena");
+    addField("bytesAllocated", &MemoryArenaStats::bytesAllocated,
+             "Total bytes allocated from the arena, including those that "
+             "were freed");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(ResourceUsageStats);
+
+ResourceUsageStatsDescription::
+ResourceUsageStatsDescription()
+{
+    addField("cpuSeconds", &ResourceUsageStats::cpuSeconds,
+             "CPU time used, summed over all of the threads that worked on "
+             "it");
+    addField("rowsScanned", &ResourceUsageStats::rowsScanned,
+             "Number of rows read from each dataset by queries");
+    addField("bytesRead", &ResourceUsageStats::bytesRead,
+             "Number of bytes read from files and URLs, by scheme (file, "
+             "s3, http, ...).  Memory mapped files count as entirely read "
+             "when they are opened.");
 }
 
 DEFINE_STRUCTURE_DESCRIPTION(ProcedureRunState);
@@ -71,8 +204,18 @@ ProcedureRunStatusDescription()
              "Timestamp at which the run started");
     addField("runFinished", &ProcedureRunStatus::runFinished,
              "Timestamp at which the run finished");
+    addField("memory", &ProcedureRunStatus::memory,
+             "Memory used by the temporary allocations of the run, once "
+             "it has finished");
+    addField("resources", &ProcedureRunStatus::resources,
+             "CPU time, rows scanned and bytes read by the run, once it has "
+             "finished");
 }
 
+static LatencyMetric procedureRunLatency
+    ("mldb_procedure_run_duration_seconds",
+     "Time taken by procedure runs, by procedure type");
+
 ProcedureRun::
 ProcedureRun(Procedure * owner,
              ProcedureRunConfig config,
@@ -80,8 +223,26 @@ ProcedureRun(Procedure * owner,
 {
     runStarted = Date::now();
     ExcAssert(owner);
+    LatencyTimer timer(procedureRunLatency.get
+                       ({ { "type", owner->getMetricsType() } }));
     this->config.reset(new ProcedureRunConfig(std::move(config)));
+
+    // Temporary allocations of the run are made from its own arena, which
+    // gives all of its memory back when the run is over
+    MemoryArena arena("procedure run " + this->config->id.rawString());
+
+    // CPU time, rows and bytes are accounted over all of its threads
+    auto usage = std::make_shared<ResourceUsage>
+        ("procedure run " + this->config->id.rawString());
     try {
+        // A run that reserved CPUs doesn't use more threads than that
+        int maxParallelism = this->config->maxParallelism;
+        if (maxParallelism == -1 && this->config->resources.cpus > 0)
+            maxParallelism = std::max<int>(1, ceil(this->config->resources.cpus));
+        ParallelismScope parallelism(maxParallelism,
+                                     this->config->priority);
+        MemoryArenaScope arenaScope(&arena);
+        ResourceUsageScope usageScope(usage.get());
         RunOutput output = owner->run(*this->config, onProgress);
         this->results = std::move(output.results);
         this->details = std::move(output.details);
@@ -90,6 +251,8 @@ ProcedureRun(Procedure * owner,
         throw;
     }
     runFinished = Date::now();
+    memory = std::make_shared<MemoryArenaStats>(arena.stats());
+    resources = std::make_shared<ResourceUsageStats>(usage->stats());
 }
 
 DEFINE_STRUCTURE_DESCRIPTION(ProcedureRun);
@@ -107,6 +270,10 @@ ProcedureRunDescription()
              "Result of running the procedure");
     addField("details", &ProcedureRun::details,
              "Details on the procedure output");
+    addField("memory", &ProcedureRun::memory,
+             "Memory used by the temporary allocations of the run");
+    addField("resources", &ProcedureRun::resources,
+             "CPU time, rows scanned and bytes read by the run");
 }
 
 
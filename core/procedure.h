@@ -40,13 +40,55 @@ constexpr char GENERIC_OUTPUT_DS_DESC[] =
 /* PROCEDURE TRAINING                                                        */
 /*****************************************************************************/
 
+enum class ParallelPriority;
+
+DECLARE_ENUM_DESCRIPTION(ParallelPriority);
+
+/** Resources that a procedure run reserves while it executes, so that
+    the scheduler of runs knows how many can execute at once.
+*/
+struct ProcedureRunResources {
+    double cpus = 0;              ///< CPUs that the run keeps busy
+    uint64_t memoryBytes = 0;     ///< Memory that the run needs
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(ProcedureRunResources);
+
+/** Where a run saves its progress as it goes, so that a run that failed
+    or was interrupted by a restart can continue from its last checkpoint
+    rather than from the beginning.  Only procedures that document it
+    save checkpoints.
+*/
+struct ProcedureRunCheckpointConfig {
+    Utf8String url;                ///< Directory of checkpoints, or empty
+    double intervalSeconds = 300;  ///< Time between checkpoints
+    bool resume = false;           ///< Continue from the last checkpoint
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(ProcedureRunCheckpointConfig);
+
 struct ProcedureRunConfig {
+    ProcedureRunConfig();
+
     Utf8String id;
     Any params;
+    int maxParallelism;           ///< Most threads the run may use, or -1
+    ParallelPriority priority;    ///< Batch unless otherwise specified
+    ProcedureRunResources resources;  ///< Reserved while the run executes
+    int queuePriority;            ///< Higher starts first when runs wait
+    ProcedureRunCheckpointConfig checkpoint;  ///< Saving of progress
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ProcedureRunConfig);
 
+struct MemoryArenaStats;
+
+DECLARE_STRUCTURE_DESCRIPTION(MemoryArenaStats);
+
+struct ResourceUsageStats;
+
+DECLARE_STRUCTURE_DESCRIPTION(ResourceUsageStats);
+
 struct ProcedureRunState {
     Utf8String state;
 };
@@ -56,6 +98,8 @@ DECLARE_STRUCTURE_DESCRIPTION(ProcedureRunState);
 struct ProcedureRunStatus: public PolyStatus {
     Date runStarted;   ///< Timestamp at which run of the procedure started
     Date runFinished;  ///< Timestamp at which run of the procedure finished
+    std::shared_ptr<MemoryArenaStats> memory;  ///< Memory used by the run
+    std::shared_ptr<ResourceUsageStats> resources;  ///< CPU, rows and I/O
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ProcedureRunStatus);
@@ -74,6 +118,8 @@ struct ProcedureRun {
     Date runFinished;
     Any results;
     Any details;
+    std::shared_ptr<MemoryArenaStats> memory;
+    std::shared_ptr<ResourceUsageStats> resources;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ProcedureRun);
@@ -8,6 +8,7 @@
 #include "mldb/types/value_description.h"
 #include "mldb/types/meta_value_description.h"
 #include <unordered_map>
+#include <mutex>
 
 
 
@@ -19,6 +20,37 @@ std::tuple<std::shared_ptr<ExpressionValueInfo>,
            ValueFunction::ToOutput>
 toValueInfo(std::shared_ptr<const ValueDescription> desc);
 
+namespace {
+
+typedef std::tuple<std::shared_ptr<ExpressionValueInfo>,
+                   ValueFunction::FromInput,
+                   ValueFunction::ToOutput> Converters;
+
+/** Return the converters for the given description.  They are only built
+    once for each description, which is normally shared between all of the
+    functions of a type.  The description is kept alive by the cache so
+    that its address can't be reused.
+*/
+Converters getConverters(const std::shared_ptr<const ValueDescription> & desc)
+{
+    static std::mutex mutex;
+    static std::unordered_map<const ValueDescription *,
+                              std::pair<std::shared_ptr<const ValueDescription>,
+                                        Converters> > cache;
+
+    std::unique_lock<std::mutex> guard(mutex);
+    auto it = cache.find(desc.get());
+    if (it != cache.end())
+        return it->second.second;
+
+    Converters result = toValueInfo(desc);
+    cache.emplace(desc.get(), std::make_pair(desc, result));
+    return result;
+}
+
+} // file scope
+
+
 /*****************************************************************************/
 /* VALUE FUNCTION                                                            */
 /*****************************************************************************/
@@ -33,9 +65,9 @@ ValueFunction(MldbEngine * engine,
       outputDescription(std::move(outputDescription))
 {
     std::tie(inputInfo, fromInput, std::ignore)
-        = toValueInfo(this->inputDescription);
+        = getConverters(this->inputDescription);
     std::tie(outputInfo, std::ignore, toOutput)
-        = toValueInfo(this->outputDescription);
+        = getConverters(this->outputDescription);
 }
     
 Any
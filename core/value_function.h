@@ -168,6 +168,23 @@ struct ValueFunctionT: public ValueFunction {
         return result;
     }
 
+    /** Bind the function to be called directly with its Input type,
+        returning its Output type, without converting either to or from an
+        ExpressionValue.  This allows the typed output of a function to be
+        passed straight into the typed input of another one.  The function
+        must outlive the returned object.
+    */
+    std::function<Output (Input)>
+    bindTyped(SqlBindingScope & outerContext) const
+    {
+        std::shared_ptr<Applier> applier
+            (bindT(outerContext, { this->inputInfo }));
+        return [this, applier] (Input input) -> Output
+            {
+                return this->applyT(*applier, std::move(input));
+            };
+    }
+
 private:
     virtual std::unique_ptr<FunctionApplier>
     bind(SqlBindingScope & outerContext,
@@ -451,7 +451,11 @@ queryFromStatementExpr(const SelectStatement & stm,
                 throw AnnotatedException(500, "No query parameter " + param); 
             };
 
-        std::shared_ptr<PipelineElement> pipeline = PipelineElement::root(scope)->statement(stm, getParamInfo);
+        // Only the first offset + limit rows are read
+        ssize_t maxRows = stm.limit == -1 ? -1 : stm.offset + stm.limit;
+        std::shared_ptr<PipelineElement> pipeline
+            = PipelineElement::root(scope)->statement(stm, getParamInfo,
+                                                      maxRows);
 
         auto boundPipeline = pipeline->bind();
 
@@ -539,8 +543,11 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
                     throw AnnotatedException(500, "No query parameter " + param);
                 };
         
+        // Only the first offset + limit rows are read
+        ssize_t maxRows = stm.limit == -1 ? -1 : stm.offset + stm.limit;
         std::shared_ptr<PipelineElement> pipeline
-            = PipelineElement::root(scope)->statement(stm, getParamInfo);
+            = PipelineElement::root(scope)->statement(stm, getParamInfo,
+                                                      maxRows);
 
         auto boundPipeline = pipeline->bind();
 
@@ -9,15 +9,22 @@
 #include "mldb/engine/bound_queries.h"
 #include "mldb/core/dataset.h"
 #include "mldb/engine/dataset_scope.h"
+#include "mldb/engine/query_spill.h"
+#include "mldb/engine/query_result_cache.h"
+#include "mldb/sql/query_explain.h"
 #include "mldb/base/parallel.h"
 #include "mldb/base/per_thread_accumulator.h"
 #include "mldb/base/parallel_merge_sort.h"
+#include "mldb/base/memory_arena.h"
+#include "mldb/base/resource_usage.h"
 #include "mldb/arch/timers.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/sql/sql_utils.h"
 #include "mldb/types/annotated_exception.h"
 #include "mldb/utils/log.h"
+#include "mldb/utils/top_n.h"
+#include "mldb/utils/lru_cache.h"
 #include "mldb/arch/demangle.h"
 
 #include <boost/algorithm/string.hpp>
@@ -94,6 +101,10 @@ struct BoundSelectQuery::Executor {
     }
 
     virtual std::shared_ptr<ExpressionValueInfo> getOutputInfo() const = 0;
+
+    /// Returns the value of a row.  This may leave out the columns that
+    /// none of the query's expressions after the WHERE clause read.
+    std::function<ExpressionValue (const RowPath & row)> getRowExpr;
 };
 
 struct UnorderedExecutor: public BoundSelectQuery::Executor {
@@ -200,7 +211,7 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                     }
                 }
 
-                ExpressionValue row = dataset.getRowExpr(rows[rowNum]);
+                ExpressionValue row = getRowExpr(rows[rowNum]);
                 auto output = processRow(rows[rowNum], row, rowNum, numPerBucket,
                                          selectStar);
 
@@ -266,7 +277,7 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                                     }
                                 }
                             }
-                            auto row = dataset.getRowExpr(rows[rowNum]);
+                            auto row = getRowExpr(rows[rowNum]);
                             auto outputRow = processRow(rows[rowNum], row, rowNum,
                                                         numPerBucket, selectStar);
                             output[rowNum-offset] = std::move(outputRow);
@@ -336,7 +347,7 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                 stream->initAt(it);
                 for (;  it < stopIt; ++it) {
                     RowPath rowName = stream->next();
-                    auto row = dataset.getRowExpr(rowName);
+                    auto row = getRowExpr(rowName);
 
                     auto output = processRow(rowName, row, it, numPerBucket, selectStar);
                     int bucketNumber
@@ -468,6 +479,63 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
         
         PerThreadAccumulator<SortedRows> accum;
 
+        // Compare two rows according to the sort criteria
+        auto compareRows = [&] (const SortedRow & row1,
+                                const SortedRow & row2) -> bool
+            {
+                return boundOrderBy.less(std::get<0>(row1), std::get<0>(row2));
+            };
+
+        // Under a memory budget, a thread that holds too many rows sorts
+        // them and spills them as a run, and the runs are merged at the end.
+        struct SpilledRuns {
+            size_t bytesHeld = 0;
+            std::vector<FrozenMemoryRegion> runs;
+        };
+
+        QueryMemoryBudget budget;
+        PerThreadAccumulator<SpilledRuns> spilled;
+
+        auto spillRun = [&] (SortedRows & rows, SpilledRuns & spill)
+            {
+                std::sort(rows.begin(), rows.end(), compareRows);
+                SpillWriter writer;
+                for (auto & row: rows) {
+                    writer.write(std::get<0>(row));
+                    writer.write(std::get<1>(row));
+                    writer.write(std::get<2>(row));
+                }
+                spill.runs.emplace_back(budget.spillFile().write(writer));
+                SortedRows().swap(rows);
+                budget.release(spill.bytesHeld);
+                spill.bytesHeld = 0;
+            };
+
+        // With a limit and no DISTINCT ON, only the first offset + limit
+        // rows in the sort order can be output, so each thread only keeps
+        // those.  Ties are broken by the position of the row, so that the
+        // rows kept don't depend on how they were split between threads.
+        typedef std::pair<SortedRow, int> NumberedRow;
+        auto compareNumbered = [&] (const NumberedRow & row1,
+                                    const NumberedRow & row2) -> bool
+            {
+                const auto & key1 = std::get<0>(row1.first);
+                const auto & key2 = std::get<0>(row2.first);
+                if (boundOrderBy.less(key1, key2))
+                    return true;
+                if (boundOrderBy.less(key2, key1))
+                    return false;
+                return row1.second < row2.second;
+            };
+        typedef TopN<NumberedRow, decltype(compareNumbered)> TopRows;
+
+        ExcAssertGreaterEqual(offset, 0);
+        bool topN = limit != -1 && numDistinctOnClauses_ == 0
+            && offset + limit < rows.size();
+
+        PerThreadAccumulator<TopRows> topAccum
+            ([&] () { return new TopRows(offset + limit, compareNumbered); });
+
         std::atomic<int64_t> rowsAdded(0);
         ProgressState progress(rows.size());
 
@@ -475,7 +543,7 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
             {
                 QueryThreadTracker childTracker = parentTracker.child();
 
-                auto row = dataset.getRowExpr(rows[rowNum]);
+                auto row = getRowExpr(rows[rowNum]);
 
                 if (onProgress && rowsAdded % PROGRESS_RATE == 0) {
                     progress = rowsAdded;
@@ -517,10 +585,31 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
                 std::vector<ExpressionValue> sortFields
                     = boundOrderBy.apply(orderByRowScope);
 
-                SortedRows * sortedRows = &accum.get();
-                sortedRows->emplace_back(std::move(sortFields),
-                                         std::move(outputRow),
-                                         std::move(calcd));
+                if (topN) {
+                    topAccum.get().add({ SortedRow(std::move(sortFields),
+                                                   std::move(outputRow),
+                                                   std::move(calcd)),
+                                         rowNum });
+                }
+                else {
+                    SortedRows * sortedRows = &accum.get();
+                    size_t bytes = 0;
+                    if (budget.enabled()) {
+                        bytes = approxMemusage(sortFields)
+                            + approxMemusage(outputRow)
+                            + approxMemusage(calcd);
+                    }
+                    sortedRows->emplace_back(std::move(sortFields),
+                                             std::move(outputRow),
+                                             std::move(calcd));
+                    if (budget.enabled()) {
+                        SpilledRuns & spill = spilled.get();
+                        spill.bytesHeld += bytes;
+                        budget.reserve(bytes);
+                        if (budget.shouldSpill(spill.bytesHeld))
+                            spillRun(*sortedRows, spill);
+                    }
+                }
 
                 ++rowsAdded;
                 return true;
@@ -534,34 +623,91 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
 
         //cerr << "map took " << timer.elapsed() << endl;
         timer.restart();
-        
-        // Compare two rows according to the sort criteria
-        auto compareRows = [&] (const SortedRow & row1,
-                                const SortedRow & row2) -> bool
+
+        // The rows in sorted order are returned one at a time by nextRow,
+        // which returns null once they're all done.
+        SortedRows rowsSorted;
+        size_t nextSorted = 0;
+        std::function<SortedRow * ()> nextRow
+            = [&] () -> SortedRow *
             {
-                return boundOrderBy.less(std::get<0>(row1), std::get<0>(row2));
+                if (nextSorted == rowsSorted.size())
+                    return nullptr;
+                return &rowsSorted[nextSorted++];
             };
-            
-        auto rowsSorted = parallelMergeSort(accum.threads, compareRows);
+
+        typedef SortedRunMerger<SortedRow, decltype(compareRows)> Merger;
+        std::unique_ptr<Merger> merger;
+        SortedRow merged;
+
+        if (topN) {
+            TopRows top(offset + limit, compareNumbered);
+            topAccum.forEach([&] (TopRows * thread)
+                             {
+                                 top.merge(std::move(*thread));
+                             });
+            for (auto & row: top.extractSorted())
+                rowsSorted.emplace_back(std::move(row.first));
+        }
+        else if (budget.hasSpilled()) {
+            // Merge the spilled runs with the rows that each thread still
+            // holds, which are sorted in place
+            std::vector<Merger::Cursor> cursors;
+            spilled.forEach([&] (SpilledRuns * thread)
+                            {
+                                for (auto & run: thread->runs) {
+                                    SpillReader reader(run);
+                                    cursors.emplace_back
+                                        ([=] (SortedRow & row) mutable
+                                         {
+                                             if (reader.done())
+                                                 return false;
+                                             std::get<0>(row) = reader.readExpressionValues();
+                                             std::get<1>(row) = reader.readNamedRowValue();
+                                             std::get<2>(row) = reader.readExpressionValues();
+                                             return true;
+                                         });
+                                }
+                            });
+            accum.forEach([&] (SortedRows * thread)
+                          {
+                              std::sort(thread->begin(), thread->end(),
+                                        compareRows);
+                              size_t pos = 0;
+                              cursors.emplace_back
+                                  ([=] (SortedRow & row) mutable
+                                   {
+                                       if (pos == thread->size())
+                                           return false;
+                                       row = std::move((*thread)[pos++]);
+                                       return true;
+                                   });
+                          });
+
+            merger.reset(new Merger(std::move(cursors), compareRows));
+            nextRow = [&] () -> SortedRow *
+                {
+                    return merger->next(merged) ? &merged : nullptr;
+                };
+        }
+        else rowsSorted = parallelMergeSort(accum.threads, compareRows);
 
         //cerr << "shuffle took " << timer.elapsed() << endl;
         timer.restart(); 
 
         // Now select only the required subset of sorted rows
-        if (limit == -1)
-            limit = rowsSorted.size();
-
-        ExcAssertGreaterEqual(offset, 0);
-
-        if (numDistinctOnClauses_ > 0) {
+        std::vector<ExpressionValue> reference;
+        reference.resize(numDistinctOnClauses_);
+        ssize_t count = 0;
 
-            std::vector<ExpressionValue> reference;
-            reference.resize(numDistinctOnClauses_);
-            ssize_t count = 0;
+        for (unsigned i = 0;  ;  ++i) {
 
-            for (unsigned i = 0;  i < rowsSorted.size();  ++i) {
+            SortedRow * sorted = nextRow();
+            if (!sorted)
+                break;
 
-                std::vector<ExpressionValue> & mark = std::get<0>(rowsSorted[i]);
+            if (numDistinctOnClauses_ > 0) {
+                std::vector<ExpressionValue> & mark = std::get<0>(*sorted);
 
                 if (i == 0) {
                     std::copy_n(mark.begin(), numDistinctOnClauses_, reference.begin());
@@ -581,40 +727,24 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
                     else
                         continue; //skip duplicates
                 }
+            }
 
-                ++count;
-
-                if (count <= offset)
-                    continue;
-
-                auto & row = std::get<1>(rowsSorted[i]);
-                auto & calcd = std::get<2>(rowsSorted[i]);
-
-                /* Finally, pass to the terminator to continue. */
-                if (!processor(row, calcd, i))
-                    return false;
+            ++count;
 
-                if (count - offset == limit)
-                    break;
-            }
+            if (count <= offset)
+                continue;
 
-        }
-        else {
-            ssize_t begin = std::min<ssize_t>(offset, rowsSorted.size());
-            ssize_t end = std::min<ssize_t>(offset + limit, rowsSorted.size());
-            for (unsigned i = begin;  i < end;  ++i) {
+            if (limit != -1 && count - offset > limit)
+                break;
 
-                auto & row = std::get<1>(rowsSorted[i]);
-                auto & calcd = std::get<2>(rowsSorted[i]);
+            auto & row = std::get<1>(*sorted);
+            auto & calcd = std::get<2>(*sorted);
 
-                /* Finally, pass to the terminator to continue. */
-                if (!processor(row, calcd, i))
-                    return false;
-            }
+            /* Finally, pass to the terminator to continue. */
+            if (!processor(row, calcd, i))
+                return false;
         }
 
-     
-
         cerr << "reduce took " << timer.elapsed() << endl;
 
         return true;
@@ -766,7 +896,7 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
 
                     //RowPath rowName = rows[rowNum];
 
-                    row = dataset.getRowExpr(rows[rowNum]);
+                    row = getRowExpr(rows[rowNum]);
 
                     // Check it matches the where expression.  If not, we don't process
                     // it.
@@ -1040,7 +1170,7 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
         int count = 0;
         for (auto & r : rowsMerged) {
 
-            ExpressionValue row = dataset.getRowExpr(r);
+            ExpressionValue row = getRowExpr(r);
             auto rowContext = context.getRowScope(r, row);
 
             whenBound.filterInPlace(row, rowContext);
@@ -1080,6 +1210,39 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
     }
 };
 
+/** Record which algorithm the WHERE clause of an explained query uses to
+    find its rows, and make the generator record the rows it finds.  Row
+    streams are read directly by the executors, so their rows aren't
+    counted.
+*/
+static void
+explainWhereGenerator(QueryExplainNode & parent,
+                      GenerateRowsWhereFunction & generator)
+{
+    static const char * complexities[] = {
+        "CONSTANT", "BETTER_THAN_TABLESCAN", "UNFILTERED_TABLESCAN",
+        "TABLESCAN"
+    };
+
+    auto node = parent.addChild("GenerateRowsWhere");
+    node->details["algorithm"] = generator.explain;
+    node->details["complexity"] = complexities[generator.complexity];
+    if (generator.rowStream)
+        node->details["rowStream"] = true;
+
+    auto exec = std::move(generator.exec);
+    generator.exec = [=] (ssize_t numToGenerate, Any token,
+                          const BoundParameters & params,
+                          const ProgressFunc & onProgress)
+        {
+            QueryExplainTimer timer(node.get());
+            auto result = exec(numToGenerate, std::move(token), params,
+                               onProgress);
+            node->rowsOut += result.first.size();
+            return result;
+        };
+}
+
 BoundSelectQuery::
 BoundSelectQuery(const SelectExpression & select,
                  const Dataset & from,
@@ -1094,12 +1257,22 @@ BoundSelectQuery(const SelectExpression & select,
       logger(getMldbLog<BoundSelectQuery>())
 {
     try {
+        if (auto parent = QueryExplainScope::current()) {
+            explainNode = parent->addChild("SelectQuery");
+            explainNode->details["select"] = select.surface;
+            explainNode->details["where"] = where.surface;
+        }
+
         SqlExpressionWhenScope whenScope(*context);
         auto whenBound = when.bind(whenScope);
 
         // Get a generator for the rows that match 
         auto whereGenerator = context->doCreateRowsWhereGenerator(where, 0, -1);
 
+        if (explainNode) {
+            explainWhereGenerator(*explainNode, whereGenerator);
+        }
+
         auto boundSelect = select.bind(*context);
 
         selectInfo = boundSelect.info;
@@ -1178,6 +1351,37 @@ BoundSelectQuery(const SelectExpression & select,
                                                  logger));
         }
 
+        // Rows are only read once they've passed the WHERE clause, so
+        // they only need the columns that the rest of the query reads.
+        UnboundEntities unbound = select.getUnbound();
+        unbound.merge(when.getUnbound());
+        unbound.merge(newOrderBy.getUnbound());
+        for (auto & c: calc) {
+            unbound.merge(c->getUnbound());
+        }
+        executor->getRowExpr = from.getRowExprProjection(unbound, alias);
+
+        // Count the rows read against the query that executes this, which
+        // isn't necessarily the one binding it
+        std::string datasetName
+            = from.config_ ? from.config_->id.rawString() : alias.rawString();
+        if (datasetName.empty())
+            datasetName = "<anonymous>";
+        executor->getRowExpr
+            = [getRowExpr = std::move(executor->getRowExpr),
+               datasetName] (const RowPath & row)
+            {
+                ResourceUsage::countRowScanned(datasetName);
+                return getRowExpr(row);
+            };
+
+        if (explainNode) {
+            std::string type = demangle(typeid(*executor));
+            if (type.find("MLDB::") == 0)
+                type = type.substr(6);
+            explainNode->details["executor"] = type;
+        }
+
     } MLDB_CATCH_ALL {
         rethrowException(KEEP_HTTP_CODE, "Binding error: "
                              + getExceptionString(),
@@ -1223,6 +1427,20 @@ execute(std::function<bool (NamedRowValue & output,
     ExcAssert(processor);
 
     try {
+        if (explainNode) {
+            QueryExplainTimer timer(explainNode.get());
+            auto explainedProcessor = [&] (NamedRowValue & output,
+                                           std::vector<ExpressionValue> & calcd,
+                                           int groupNum)
+                {
+                    ++explainNode->rowsOut;
+                    explainNode->bytes += approxMemusage(output);
+                    return processor(output, calcd, groupNum);
+                };
+            return executor->execute(explainedProcessor, processInParallel,
+                                     offset, limit, onProgress);
+        }
+
         return executor->execute(processor, processInParallel, offset, limit, onProgress);
     } MLDB_CATCH_ALL {
         rethrowException(KEEP_HTTP_CODE, "Execution error: "
@@ -1272,6 +1490,21 @@ executeExpr(std::function<bool (Path & rowName,
     ExcAssert(processor);
 
     try {
+        if (explainNode) {
+            QueryExplainTimer timer(explainNode.get());
+            auto explainedProcessor = [&] (Path & rowName,
+                                           ExpressionValue & output,
+                                           std::vector<ExpressionValue> & calcd,
+                                           int groupNum)
+                {
+                    ++explainNode->rowsOut;
+                    explainNode->bytes += approxMemusage(output);
+                    return processor(rowName, output, calcd, groupNum);
+                };
+            return executor->executeExpr(explainedProcessor, processInParallel,
+                                         offset, limit, onProgress);
+        }
+
         return executor->executeExpr(processor, processInParallel,
                                      offset, limit, onProgress);
     } MLDB_CATCH_ALL {
@@ -1431,6 +1664,14 @@ struct GroupContext: public SqlExpressionDatasetScope {
                                                         args, argScope);
     }
 
+    // Group by expressions are only executed a row at a time
+    virtual BatchColumnGetter
+    doGetColumnBatch(const Utf8String & tableName,
+                     const ColumnPath & columnName)
+    {
+        return BatchColumnGetter();
+    }
+
     // Within a group by context, we can get either:
     // 1.  The value of the variable in the row
     // 2.  The value of the variable within the group by expression
@@ -1572,6 +1813,25 @@ struct GroupContext: public SqlExpressionDatasetScope {
                .mergeInto(outMapInstance[i].get(), inMapInstance[i].get());
         }
     }
+
+    /// Can a copy be made of the state of every aggregator?
+    bool canCloneAggregators() const
+    {
+        for (auto & agg: outputAgg) {
+            if (!agg.aggregate.clone)
+                return false;
+        }
+        return true;
+    }
+
+    GroupMapValue cloneThreadMap(const GroupMapValue & mapInstance) const
+    {
+        GroupMapValue result(outputAgg.size());
+        for (size_t i = 0;  i < outputAgg.size();  ++i) {
+            result[i] = outputAgg[i].aggregate.clone(mapInstance[i].get());
+        }
+        return result;
+    }
              
     std::vector<std::shared_ptr<ExpressionValueInfo> > groupInfo;
     std::vector<OutputAggregator> outputAgg;    
@@ -1626,6 +1886,55 @@ replaceGroupByKey(const std::shared_ptr<SqlExpression> p, const std::vector<Utf8
     return result;
 }
 
+//Replace all aggregators with their value, when they were calculated by
+//the dataset
+static std::shared_ptr<SqlExpression>
+replaceAggregators(const std::shared_ptr<SqlExpression> p,
+                   const std::vector<Utf8String> & printAggregators,
+                   const std::vector<ExpressionValue> & values)
+{
+    std::function<std::shared_ptr<SqlExpression> (std::shared_ptr<SqlExpression> a)>
+        doArg;
+
+    auto onChild = [&] (std::vector<std::shared_ptr<SqlExpression> > args)
+        {
+            for (auto & a: args) {
+                a = doArg(a);
+            }
+
+            return args;
+        };
+
+    doArg = [&] (std::shared_ptr<SqlExpression> a)
+        -> std::shared_ptr<SqlExpression>
+        {
+            if (a->isAggregator()) {
+                auto iter = std::find(printAggregators.begin(),
+                                      printAggregators.end(), a->print());
+                if (iter != printAggregators.end()) {
+                    return std::make_shared<ConstantExpression>
+                        (values.at(iter - printAggregators.begin()));
+                }
+            }
+
+            return a->transform(onChild);
+        };
+
+    auto result = doArg(p);
+    result->surface = result->print();
+    return result;
+}
+
+/// Number of buckets to split the rows of the dataset into
+static size_t getNumBuckets(const Dataset & from)
+{
+    size_t maxNumRow = from.getMatrixView()->getRowCount();
+    int maxNumTask = numCpus() * TASK_PER_THREAD;
+    //try to have at least MIN_ROW_PER_TASK rows per task
+    size_t numBuckets = maxNumRow <= maxNumTask*MIN_ROW_PER_TASK? maxNumRow / maxNumTask : maxNumTask;
+    return std::max(numBuckets, (size_t)1U);
+}
+
 BoundGroupByQuery::
 BoundGroupByQuery(const SelectExpression & select,
                   const Dataset & from,
@@ -1638,6 +1947,7 @@ BoundGroupByQuery(const SelectExpression & select,
                   const SqlExpression & rowName,
                   const OrderByExpression & orderBy)
     : from(from),
+      alias(alias),
       when(when),
       where(where),
       rowContext(new SqlExpressionDatasetScope(from, alias)),
@@ -1646,7 +1956,9 @@ BoundGroupByQuery(const SelectExpression & select,
       having(having.shallowCopy()),
       orderBy(orderBy),
       numBuckets(1),
-      logger(getMldbLog<BoundGroupByQuery>())
+      logger(getMldbLog<BoundGroupByQuery>()),
+      aggregatorsPushedDown(false),
+      outputPushedDownGroup(false)
 {
     for (auto & g: groupBy.clauses) {
         calc.push_back(g);
@@ -1662,15 +1974,65 @@ BoundGroupByQuery(const SelectExpression & select,
         }
     }
 
-    size_t maxNumRow = from.getMatrixView()->getRowCount();
-    int maxNumTask = numCpus() * TASK_PER_THREAD;
-    //try to have at least MIN_ROW_PER_TASK rows per task
-    numBuckets = maxNumRow <= maxNumTask*MIN_ROW_PER_TASK? maxNumRow / maxNumTask : maxNumTask;
-    numBuckets = std::max(numBuckets, (size_t)1U);
+    // With a single group, the dataset may be able to calculate the
+    // aggregators without us reading the rows.  As when there are no rows,
+    // the group is only output if it has rows or counts them.
+    std::vector<ExpressionValue> pushedDownValues;
+    uint64_t pushedDownRows = 0;
+    if (groupBy.clauses.empty() && when.when->isConstantTrue()
+        && from.pushdownAggregators(alias, where, aggregatorsExpr,
+                                    pushedDownValues, pushedDownRows)) {
+        ExcAssertEqual(pushedDownValues.size(), aggregatorsExpr.size());
+        aggregatorsPushedDown = true;
+        outputPushedDownGroup = pushedDownRows > 0;
+        for (auto & expr: aggregatorsExpr) {
+            auto fn = dynamic_cast<const FunctionCallExpression *>(expr.get());
+            if (fn->functionName == "count")
+                outputPushedDownGroup = true;
+        }
+    }
+
+    if (!aggregatorsPushedDown)
+        numBuckets = getNumBuckets(from);
 
-    // bind the subselect
+    if (auto parent = QueryExplainScope::current()) {
+        explainNode = parent->addChild("GroupByQuery");
+        explainNode->details["groupBy"] = groupBy.surface;
+        explainNode->details["having"] = this->having->surface;
+        explainNode->details["numBuckets"] = numBuckets;
+        explainNode->details["aggregatorsPushedDown"] = aggregatorsPushedDown;
+    }
+
+    // bind the subselect, which is part of our plan
     //false means no implicit sort by rowhash, we want unsorted
-    subSelect.reset(new BoundSelectQuery(subSelectExpr, from, alias, when, where, subOrderBy, calc, numBuckets));
+    bool dependsOnlyOnRows = false;
+    if (!aggregatorsPushedDown) {
+        QueryExplainScope explainScope(explainNode);
+        QueryDependencyScope dependencies;
+        subSelect.reset(new BoundSelectQuery(subSelectExpr, from, alias, when, where, subOrderBy, calc, numBuckets));
+        dependsOnlyOnRows
+            = dependencies.cacheable && dependencies.datasets.empty();
+    }
+
+    // The groups of each partition of the dataset can be kept for the
+    // next query if they depend only on its rows, which isn't the case if
+    // the query has parameters, reads another dataset or calls a function
+    // that may return something different next time.
+    if (dependsOnlyOnRows && !from.getAggregationPartitions().empty()) {
+        UnboundEntities unbound = where.getUnbound();
+        if (when.when)
+            unbound.merge(when.when->getUnbound());
+        for (auto & c: calc)
+            unbound.merge(c->getUnbound());
+
+        if (unbound.params.empty()) {
+            partialKey = when.print() + "\n" + where.print();
+            for (auto & c: calc)
+                partialKey += "\n" + c->print();
+            for (auto & a: aggregatorsExpr)
+                partialKey += "\n" + a->print();
+        }
+    }
 
     std::vector<std::shared_ptr<ExpressionValueInfo> > groupInfo;
     for (size_t c = 0; c < groupBy.clauses.size(); ++c) {
@@ -1697,11 +2059,384 @@ BoundGroupByQuery(const SelectExpression & select,
 
     auto pRowName = replaceGroupByKey(rowName.shallowCopy(), printGroupbyClauses);
 
+    if (aggregatorsPushedDown) {
+        std::vector<Utf8String> printAggregators;
+        for (auto & a: aggregatorsExpr)
+            printAggregators.push_back(a->print());
+
+        for (auto & p: this->select.clauses) {
+            p = dynamic_pointer_cast<SqlRowExpression>
+                (replaceAggregators(p, printAggregators, pushedDownValues));
+        }
+        for (auto & p: this->orderBy.clauses) {
+            p.first = replaceAggregators(p.first, printAggregators,
+                                         pushedDownValues);
+        }
+        this->having = replaceAggregators(this->having, printAggregators,
+                                          pushedDownValues);
+        pRowName = replaceAggregators(pRowName, printAggregators,
+                                      pushedDownValues);
+    }
+
      // Bind the row name expression
     boundRowName = pRowName->bind(*groupContext);
 
 }
 
+
+/*****************************************************************************/
+/* GROUP HASH TABLE                                                          */
+/*****************************************************************************/
+
+/** Open addressing hash table from the key of each group to the state of
+    its aggregators.  Two keys are the same group if neither sorts before
+    the other, which is how the groups were distinguished when they were
+    kept in a std::map.  Entries are kept in the order they were added so
+    that merging tables gives the same result every time.
+*/
+struct GroupHashTable {
+    typedef std::vector<ExpressionValue> RowKey;
+
+    struct Entry {
+        uint64_t hash;
+        RowKey key;
+        GroupMapValue value;
+    };
+
+    /// Entries in the order they were added.  These and the slots only
+    /// live as long as the query, so they come from its memory arena.
+    std::pmr::vector<Entry> entries { MemoryArena::currentResource() };
+
+    /// Open addressed slots; zero is empty, otherwise entry number + 1
+    std::pmr::vector<uint32_t> slots { MemoryArena::currentResource() };
+
+    /** Hash of a group key.  It must be the same for keys which neither
+        sort before the other, so all NaNs hash the same.
+    */
+    static uint64_t hashKey(const ExpressionValue * key, size_t n)
+    {
+        uint64_t result = n;
+        for (size_t i = 0;  i < n;  ++i) {
+            uint64_t h = key[i].isAtom() && key[i].getAtom().isNaN()
+                ? 0x7ff8000000000000ULL : key[i].hash();
+            result = (result ^ h) * 0x9e3779b97f4a7c15ULL;
+            result ^= result >> 29;
+        }
+        return result;
+    }
+
+    static bool sameKey(const ExpressionValue * key, size_t n,
+                        const RowKey & other)
+    {
+        if (other.size() != n)
+            return false;
+        for (size_t i = 0;  i < n;  ++i) {
+            if (key[i] < other[i] || other[i] < key[i])
+                return false;
+        }
+        return true;
+    }
+
+    /// Return the entry with the given key, or null if there is none
+    Entry * find(uint64_t hash, const ExpressionValue * key, size_t n)
+    {
+        if (slots.empty())
+            return nullptr;
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;  slots[i];  i = (i + 1) & mask) {
+            Entry & entry = entries[slots[i] - 1];
+            if (entry.hash == hash && sameKey(key, n, entry.key))
+                return &entry;
+        }
+        return nullptr;
+    }
+
+    /// Add an entry for a key that isn't in the table
+    Entry & add(uint64_t hash, RowKey key, GroupMapValue value)
+    {
+        if ((entries.size() + 1) * 2 > slots.size())
+            rehash(std::max<size_t>(16, slots.size() * 2));
+
+        entries.push_back({ hash, std::move(key), std::move(value) });
+        insertSlot(hash, entries.size());
+        return entries.back();
+    }
+
+private:
+    void insertSlot(uint64_t hash, uint32_t slotValue)
+    {
+        size_t mask = slots.size() - 1;
+        size_t i = hash & mask;
+        while (slots[i])
+            i = (i + 1) & mask;
+        slots[i] = slotValue;
+    }
+
+    void rehash(size_t capacity)
+    {
+        slots.clear();
+        slots.resize(capacity);
+        for (size_t i = 0;  i < entries.size();  ++i)
+            insertSlot(entries[i].hash, i + 1);
+    }
+};
+
+/** Groups are aggregated in two phases.  First, each bucket of rows
+    aggregates into its own tables, partitioned by the top bits of the
+    hash of the group key.  Then each partition is merged over all of the
+    buckets in parallel, as no group is in more than one partition.
+*/
+static constexpr int PARTITION_BITS = 8;
+static constexpr size_t NUM_PARTITIONS = 1 << PARTITION_BITS;
+
+static size_t getPartition(uint64_t hash)
+{
+    return hash >> (64 - PARTITION_BITS);
+}
+
+bool
+BoundGroupByQuery::
+aggregateGroups(BoundSelectQuery & query,
+                size_t numBuckets,
+                std::vector<GroupHashTable> & output,
+                const ProgressFunc & onProgress)
+{
+    typedef std::vector<ExpressionValue> RowKey;
+
+    std::vector<std::vector<GroupHashTable> > accum(numBuckets);
+
+    // Under a memory budget, once the groups held take more than the
+    // budget, rows of groups that a bucket doesn't already hold are
+    // spilled to their partition rather than starting a new group.  They
+    // are aggregated once the partition has been merged, so each of those
+    // groups is only held once rather than once per bucket.
+    static constexpr size_t SPILL_BUFFER_BYTES = 65536;
+
+    struct SpilledPartition {
+        std::mutex mutex;
+        SpillWriter writer;
+        std::vector<FrozenMemoryRegion> runs;
+    };
+
+    QueryMemoryBudget budget;
+    std::vector<SpilledPartition> spilled(budget.enabled() ? NUM_PARTITIONS : 0);
+
+    size_t keySize = groupBy.clauses.size();
+
+    // When we get a row, we record it under the group key
+    auto onRow = [&] (NamedRowValue & row,
+                      const std::vector<ExpressionValue> & calc,
+                      int groupNum)
+    {
+       std::vector<GroupHashTable> & partitions = accum[groupNum];
+       if (partitions.empty())
+           partitions.resize(NUM_PARTITIONS);
+
+       uint64_t hash = GroupHashTable::hashKey(calc.data(), keySize);
+       size_t partition = getPartition(hash);
+       GroupHashTable & table = partitions[partition];
+
+       GroupHashTable::Entry * entry = table.find(hash, calc.data(), keySize);
+       if (!entry) {
+          if (budget.overBudget()) {
+              SpilledPartition & spill = spilled[partition];
+              std::unique_lock<std::mutex> guard(spill.mutex);
+              spill.writer.write(calc);
+              if (spill.writer.size() >= SPILL_BUFFER_BYTES) {
+                  spill.runs.emplace_back(budget.spillFile().write(spill.writer));
+                  spill.writer.clear();
+              }
+              return true;
+          }
+
+          //initialize aggregator data
+          GroupMapValue value;
+          groupContext->initializePerThreadAggregators(value);
+          entry = &table.add(hash,
+                             RowKey(calc.begin(), calc.begin() + keySize),
+                             std::move(value));
+
+          if (budget.enabled())
+              budget.reserve(sizeof(*entry) + approxMemusage(calc));
+       }
+
+       groupContext->aggregateRow(entry->value, calc);
+
+       return true;
+    };  
+            
+    query.execute(onRow, true /*processInParallel*/, 0, -1, onProgress);
+
+    for (auto & spill: spilled) {
+        if (!spill.writer.empty()) {
+            spill.runs.emplace_back(budget.spillFile().write(spill.writer));
+            spill.writer.clear();
+        }
+    }
+  
+    // Merge each partition over the buckets in fixed order.  The first
+    // bucket to see a group gives its state to the merged table.
+    size_t numPartialGroups = 0;
+    for (auto & partitions: accum) {
+        for (auto & table: partitions)
+            numPartialGroups += table.entries.size();
+    }
+
+    auto mergePartition = [&] (size_t p)
+    {
+        GroupHashTable & dest = output[p];
+        for (auto & partitions: accum) {
+            if (partitions.empty())
+                continue;
+            for (auto & src: partitions[p].entries) {
+                GroupHashTable::Entry * entry
+                    = dest.find(src.hash, src.key.data(), src.key.size());
+                if (entry)
+                    groupContext->mergeThreadMap(entry->value, src.value);
+                else dest.add(src.hash, std::move(src.key),
+                              std::move(src.value));
+            }
+            partitions[p] = GroupHashTable();
+        }
+
+        if (spilled.empty())
+            return;
+
+        // Aggregate the rows that were spilled for this partition
+        for (auto & run: spilled[p].runs) {
+            SpillReader reader(run);
+            while (!reader.done()) {
+                std::vector<ExpressionValue> calc
+                    = reader.readExpressionValues();
+                uint64_t hash = GroupHashTable::hashKey(calc.data(), keySize);
+                GroupHashTable::Entry * entry
+                    = dest.find(hash, calc.data(), keySize);
+                if (!entry) {
+                    GroupMapValue value;
+                    groupContext->initializePerThreadAggregators(value);
+                    entry = &dest.add(hash,
+                                      RowKey(calc.begin(),
+                                             calc.begin() + keySize),
+                                      std::move(value));
+                }
+                groupContext->aggregateRow(entry->value, calc);
+            }
+        }
+        spilled[p].runs.clear();
+    };
+
+    {
+//        STACK_PROFILE(MergingBuckets);
+        if (numPartialGroups >= 10000 || budget.hasSpilled())
+            parallelMap(0, NUM_PARTITIONS, mergePartition);
+        else {
+            for (size_t p = 0;  p < NUM_PARTITIONS;  ++p)
+                mergePartition(p);
+        }
+    }
+
+    return budget.hasSpilled();
+}
+
+
+/*****************************************************************************/
+/* PARTIAL GROUPS                                                            */
+/*****************************************************************************/
+
+/** The groups of a GROUP BY query over one partition of a dataset, before
+    its HAVING, SELECT and ORDER BY are applied.  They are kept so that the
+    next query over the same partition can merge copies of them instead of
+    aggregating its rows again, and are never changed once made.
+*/
+struct PartialGroups {
+    std::weak_ptr<Dataset> dataset;       ///< Partition they were made from
+    std::vector<GroupHashTable> tables;   ///< Groups, by partition of hash
+};
+
+/** Partial groups, keyed on the query, the partition and the generation of
+    its data.  The key doesn't include the dataset being queried, so that
+    windows which share a partition share its groups.  This is safe as
+    only aggregators in scalar mode, whose state type depends only on the
+    aggregator, can copy their state.
+*/
+static LruCache<Utf8String, std::shared_ptr<const PartialGroups> >
+partialGroupsCache(256);
+
+bool
+BoundGroupByQuery::
+mergePartialGroups(const std::vector<std::shared_ptr<Dataset> > & partitions,
+                   std::vector<GroupHashTable> & output,
+                   const ProgressFunc & onProgress)
+{
+    bool hasSpilled = false;
+    size_t numReused = 0;
+    size_t numPartialGroups = 0;
+    std::vector<std::shared_ptr<const PartialGroups> > partials;
+
+    for (auto & dataset: partitions) {
+        Utf8String key = partialKey
+            + "\n" + std::to_string((uintptr_t)dataset.get())
+            + "\n" + std::to_string(dataset->getDataGeneration());
+
+        std::shared_ptr<const PartialGroups> groups;
+        if (partialGroupsCache.get(key, groups)
+            && groups->dataset.lock() == dataset) {
+            ++numReused;
+        }
+        else {
+            // The generation is read before the rows, so that if the
+            // partition changes while it's aggregated, the groups are
+            // stale rather than being kept under the new generation.
+            auto newGroups = std::make_shared<PartialGroups>();
+            newGroups->dataset = dataset;
+            newGroups->tables.resize(NUM_PARTITIONS);
+            size_t numBuckets = getNumBuckets(*dataset);
+            BoundSelectQuery query(subSelectExpr, *dataset, alias, when,
+                                   where, subOrderBy, calc, numBuckets);
+            if (aggregateGroups(query, numBuckets, newGroups->tables,
+                                onProgress))
+                hasSpilled = true;
+            partialGroupsCache.put(key, newGroups);
+            groups = std::move(newGroups);
+        }
+
+        for (auto & table: groups->tables)
+            numPartialGroups += table.entries.size();
+        partials.emplace_back(std::move(groups));
+    }
+
+    // Merging takes the contents of its source, so it's copies of the
+    // kept groups that are merged.
+    auto mergePartition = [&] (size_t p)
+    {
+        GroupHashTable & dest = output[p];
+        for (auto & groups: partials) {
+            for (auto & src: groups->tables[p].entries) {
+                GroupMapValue value = groupContext->cloneThreadMap(src.value);
+                GroupHashTable::Entry * entry
+                    = dest.find(src.hash, src.key.data(), src.key.size());
+                if (entry)
+                    groupContext->mergeThreadMap(entry->value, value);
+                else dest.add(src.hash, src.key, std::move(value));
+            }
+        }
+    };
+
+    if (numPartialGroups >= 10000)
+        parallelMap(0, NUM_PARTITIONS, mergePartition);
+    else {
+        for (size_t p = 0;  p < NUM_PARTITIONS;  ++p)
+            mergePartition(p);
+    }
+
+    if (explainNode) {
+        explainNode->details["partitions"] = partitions.size();
+        explainNode->details["partitionsReused"] = numReused;
+    }
+
+    return hasSpilled;
+}
+
 std::pair<bool, std::shared_ptr<ExpressionValueInfo> >
 BoundGroupByQuery::
 execute(RowProcessor processor,
@@ -1711,6 +2446,18 @@ execute(RowProcessor processor,
 {
     //STACK_PROFILE(BoundGroupByQuery);
 
+    QueryExplainTimer explainTimer(explainNode.get());
+    if (explainNode) {
+        auto node = explainNode;
+        auto onOutput = std::move(processor.processorfct);
+        processor.processorfct = [node, onOutput] (NamedRowValue & output)
+            {
+                ++node->rowsOut;
+                node->bytes += approxMemusage(output);
+                return onOutput(output);
+            };
+    }
+
     typedef std::tuple<std::vector<ExpressionValue>,
                        NamedRowValue,
                        std::vector<ExpressionValue> >
@@ -1720,8 +2467,6 @@ execute(RowProcessor processor,
     std::atomic<ssize_t> groupsDone(0);
 
     typedef std::vector<ExpressionValue> RowKey;
-    typedef std::map<RowKey, GroupMapValue> GroupByMapType;
-    std::vector<GroupByMapType> accum(numBuckets);
 
     for (const auto & c: select.clauses) {
         if (c->isWildcard()) {
@@ -1746,65 +2491,56 @@ execute(RowProcessor processor,
     //we placed the orderby aggregators after the having aggregator in the list
     boundOrderBy = orderBy.bindAll(*groupContext);
 
-    // When we get a row, we record it under the group key
-    auto onRow = [&] (NamedRowValue & row,
-                      const std::vector<ExpressionValue> & calc,
-                      int groupNum)
-    {
-       GroupByMapType & map = accum[groupNum];
-       RowKey rowKey(calc.begin(), calc.begin() + groupBy.clauses.size());
-
-       auto pair = map.insert({rowKey, GroupMapValue()});
-       auto & iter = pair.first;
-       if (pair.second)
-       {
-          //initialize aggregator data
-          groupContext->initializePerThreadAggregators(iter->second);
-       }
-
-       groupContext->aggregateRow(iter->second, calc);
+    // If the dataset is made up of partitions whose groups can be kept,
+    // we merge the groups of each partition rather than aggregating the
+    // rows of the whole dataset.
+    std::vector<std::shared_ptr<Dataset> > partitions;
+    if (!partialKey.empty() && groupContext->canCloneAggregators())
+        partitions = from.getAggregationPartitions();
+
+    std::vector<GroupHashTable> merged(NUM_PARTITIONS);
+    bool hasSpilled = false;
+    if (aggregatorsPushedDown) {
+        // The aggregators are already calculated; there is nothing to read
+    }
+    else if (partitions.empty())
+        hasSpilled = aggregateGroups(*subSelect, numBuckets, merged, onProgress);
+    else hasSpilled = mergePartialGroups(partitions, merged, onProgress);
+
+    if (explainNode)
+        explainNode->details["spilled"] = hasSpilled;
+
+    // Groups are output in the order of their keys
+    std::vector<GroupHashTable::Entry *> destMap;
+    for (auto & table: merged) {
+        for (auto & entry: table.entries)
+            destMap.push_back(&entry);
+    }
 
-       return true;
-    };  
-            
-    subSelect->execute(onRow, true /*processInParallel*/, 0, -1, onProgress);
-  
-    //merge the maps in fixed order
-    GroupByMapType destMap;
-    std::vector<GroupByMapType>& threads = accum;
-    if (threads.size() > 0)
-    {
-//        STACK_PROFILE(MergingBuckets);
-        for (auto & srcMap : threads)
+    auto compareKeys = [] (const GroupHashTable::Entry * e1,
+                           const GroupHashTable::Entry * e2)
         {
-            for (auto it = srcMap.begin(); it != srcMap.end(); ++it)
-            {
-                auto pair = destMap.insert({it->first, GroupMapValue()});
-                auto destiter = pair.first;
-                if (pair.second)
-                {
-                    //initialize aggregator data
-                    groupContext->initializePerThreadAggregators(destiter->second);
-                }
+            return e1->key < e2->key;
+        };
 
-                groupContext->mergeThreadMap(destiter->second, it->second);
-            }
-        }
-    }
+    parallelQuickSortRecursive<GroupHashTable::Entry *>
+        (destMap.begin(), destMap.end(), compareKeys);
 
-    if (destMap.empty() && groupContext->evaluateEmptyGroups
-        && groupBy.clauses.empty())
+    GroupHashTable::Entry emptyGroup;
+    bool outputEmptyGroup = aggregatorsPushedDown
+        ? outputPushedDownGroup : groupContext->evaluateEmptyGroups;
+    if (destMap.empty() && outputEmptyGroup && groupBy.clauses.empty())
     {
-        auto pair = destMap.emplace(RowKey(), GroupMapValue());
-        groupContext->initializePerThreadAggregators(pair.first->second);
+        groupContext->initializePerThreadAggregators(emptyGroup.value);
+        destMap.push_back(&emptyGroup);
     }
 
     //output rows
     //each entry in the final map should be an output row for us   
     for (auto it = destMap.begin(); it != destMap.end(); ++it)
     {
-        RowKey rowKey = it->first;
-        groupContext->aggData = it->second;
+        const RowKey & rowKey = (*it)->key;
+        groupContext->aggData = (*it)->value;
 
          // Create the context to evaluate the row name and order by
         NamedRowValue outputRow;
@@ -17,6 +17,7 @@ namespace MLDB {
 
 struct GroupContext;
 struct SqlExpressionDatasetScope;
+struct QueryExplainNode;
 
 
 /** This object is designed to track whether a thread is executing a
@@ -134,6 +135,9 @@ struct BoundSelectQuery {
 
     std::shared_ptr<Executor> executor;
 
+    /// Node of the plan to record into, if the query is being explained
+    std::shared_ptr<QueryExplainNode> explainNode;
+
     std::shared_ptr<ExpressionValueInfo> getSelectOutputInfo() const;
 };
 
@@ -141,6 +145,9 @@ struct BoundSelectQuery {
 /*****************************************************************************/
 /* BOUND GROUP BY QUERY                                                      */
 /*****************************************************************************/
+
+struct GroupHashTable;
+
 struct BoundGroupByQuery {
 
    BoundGroupByQuery(const SelectExpression & select,
@@ -159,6 +166,7 @@ struct BoundGroupByQuery {
                      const ProgressFunc & onProgress);
 
     const Dataset & from;
+    Utf8String alias;
     WhenExpression when;
     const SqlExpression & where;
     std::shared_ptr<SqlExpressionDatasetScope> rowContext;
@@ -191,8 +199,36 @@ struct BoundGroupByQuery {
 
     size_t numBuckets;
 
+    /// Node of the plan to record into, if the query is being explained
+    std::shared_ptr<QueryExplainNode> explainNode;
+
     std::shared_ptr<spdlog::logger> logger;
 
+    /// Identifies what the query aggregates, for keeping the groups of
+    /// each partition of the dataset.  Empty if they can't be kept.
+    Utf8String partialKey;
+
+    /// Set when the dataset calculated the aggregators itself, in which
+    /// case they have been replaced by their values and no rows are read
+    bool aggregatorsPushedDown;
+
+    /// When the aggregators were pushed down, whether the group is output
+    bool outputPushedDownGroup;
+
+    /// Aggregate the rows of the query, which was bound with the given
+    /// number of buckets, into the groups of each partition of their
+    /// hash.  Returns true if rows were spilled.
+    bool aggregateGroups(BoundSelectQuery & query,
+                         size_t numBuckets,
+                         std::vector<GroupHashTable> & output,
+                         const ProgressFunc & onProgress);
+
+    /// Merge the groups of each of the given partitions of the dataset,
+    /// aggregating those that aren't kept.  Returns true if rows were
+    /// spilled.
+    bool mergePartialGroups(const std::vector<std::shared_ptr<Dataset> > & partitions,
+                            std::vector<GroupHashTable> & output,
+                            const ProgressFunc & onProgress);
 };
 
 } // namespace MLDB
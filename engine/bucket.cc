@@ -14,6 +14,8 @@
 #include "mldb/utils/buckets.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/types/string.h"
+#include "mldb/utils/sketches.h"
+#include "mldb/base/parallel.h"
 
 #include <algorithm>
 #include <unordered_map>
@@ -71,6 +73,30 @@ init(size_t numElements, uint32_t numBuckets)
     this->numWritten = 0;
 }
 
+void
+WritableBucketList::
+writeParallel(const uint32_t * values, size_t n)
+{
+    ExcAssertEqual(numWritten, 0);
+
+    // Each thread writes a whole number of words
+    static constexpr size_t ENTRIES_PER_JOB = 64 * 1024;
+
+    auto doJob = [&] (size_t start, size_t end)
+        {
+            WritableBucketList writer = atOffset(start);
+            for (size_t i = start;  i < end;  ++i)
+                writer.write(values[i]);
+        };
+
+    parallelMapChunked(0, n, ENTRIES_PER_JOB, doJob);
+
+    size_t bits = n * entryBits;
+    current += bits / 64;
+    bitsWritten = bits % 64;
+    numWritten = n;
+}
+
 
 /*****************************************************************************/
 /* BUCKET DESCRIPTIONS                                                       */
@@ -108,6 +134,39 @@ getBucket(const CellValue & val) const
     throw AnnotatedException(500, "Unknown CellValue type for getBucket()");
 }
 
+void
+BucketDescriptions::
+getBuckets(const CellValue * values, size_t n, uint32_t * buckets) const
+{
+    // Numbers are gathered into blocks and looked up together
+    static constexpr size_t BLOCK_SIZE = 256;
+    double numbers[BLOCK_SIZE];
+    uint32_t positions[BLOCK_SIZE];
+    uint32_t numberBuckets[BLOCK_SIZE];
+    size_t numNumbers = 0;
+
+    auto flush = [&] ()
+        {
+            numeric.getBuckets(numbers, numNumbers, numberBuckets);
+            for (size_t i = 0;  i < numNumbers;  ++i)
+                buckets[positions[i]] = numberBuckets[i];
+            numNumbers = 0;
+        };
+
+    for (size_t i = 0;  i < n;  ++i) {
+        const CellValue & val = values[i];
+        if (val.isNumber() && numeric.active) {
+            numbers[numNumbers] = val.toDouble();
+            positions[numNumbers] = i;
+            if (++numNumbers == BLOCK_SIZE)
+                flush();
+        }
+        else buckets[i] = getBucket(val);
+    }
+
+    flush();
+}
+
 uint32_t
 NumericValues::
 getBucket(double val) const
@@ -118,6 +177,105 @@ getBucket(double val) const
         - splits.begin() + offset;
 }
 
+void
+NumericValues::
+getBuckets(const double * values, size_t n, uint32_t * buckets) const
+{
+    if (!active)
+        throw AnnotatedException(500, "Attempt to get bucket from non-numeric value");
+
+    size_t numSplits = splits.size();
+    if (numSplits == 0) {
+        std::fill(buckets, buckets + n, offset);
+        return;
+    }
+
+    const double * s = splits.data();
+    static constexpr size_t LANES = 16;
+
+    for (size_t i = 0;  i < n;  i += LANES) {
+        size_t m = std::min(LANES, n - i);
+        const double * v = values + i;
+
+        // Branchless lower bound; the sequence of lengths doesn't depend
+        // on the value, so all lanes take the same number of steps
+        uint32_t base[LANES] = { 0 };
+        for (size_t len = numSplits;  len > 1;  ) {
+            size_t half = len / 2;
+            for (size_t j = 0;  j < m;  ++j)
+                base[j] += (s[base[j] + half] < v[j]) * half;
+            len -= half;
+        }
+        for (size_t j = 0;  j < m;  ++j)
+            buckets[i + j] = base[j] + (s[base[j]] < v[j]) + offset;
+    }
+}
+
+std::vector<double>
+NumericValues::
+calcSplits(std::vector<double> values, int numBuckets)
+{
+    // Below this many values, they're simply sorted and each distinct value
+    // counts once
+    static constexpr size_t MIN_VALUES_FOR_SKETCH = 1 << 20;
+    static constexpr size_t VALUES_PER_SKETCH = 1 << 16;
+
+    std::vector<std::pair<float, float> > freqPairs;
+    size_t numDistinct;
+
+    if (numBuckets == -1 || values.size() < MIN_VALUES_FOR_SKETCH) {
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()),
+                     values.end());
+        for (auto & n: values)
+            freqPairs.emplace_back(n, 1);
+        numDistinct = values.size();
+    }
+    else {
+        // Each block of values is sorted and made unique independently,
+        // and goes into its own sketch; the sketches are then merged.
+        // Values that are in more than one block count more than once.
+        size_t numBlocks
+            = (values.size() + VALUES_PER_SKETCH - 1) / VALUES_PER_SKETCH;
+        uint32_t k = std::max(200, 8 * numBuckets);
+        std::vector<KllSketch> sketches(numBlocks, KllSketch(k));
+
+        auto doBlock = [&] (size_t b)
+            {
+                auto first = values.begin() + b * VALUES_PER_SKETCH;
+                auto last = values.begin()
+                    + std::min(values.size(), (b + 1) * VALUES_PER_SKETCH);
+                std::sort(first, last);
+                last = std::unique(first, last);
+                for (; first != last;  ++first)
+                    sketches[b].insert(*first);
+            };
+
+        parallelMap(0, numBlocks, doBlock);
+
+        for (size_t i = 1;  i < numBlocks;  ++i)
+            sketches[0].merge(sketches[i]);
+
+        values.clear();  values.shrink_to_fit();
+
+        auto weighted = sketches[0].getWeightedValues();
+        for (auto & v: weighted)
+            freqPairs.emplace_back(v.first, v.second);
+        numDistinct = weighted.size();
+    }
+
+    std::vector<float> splitPoints;
+    BucketFreqs freqs(freqPairs.begin(), freqPairs.end());
+
+    if (numBuckets != -1 && numDistinct > numBuckets) {
+        bucket_dist_reduced(splitPoints, freqs, numBuckets);
+    } else {
+        bucket_dist_full(splitPoints, freqs);
+    }
+
+    return std::vector<double>(splitPoints.begin(), splitPoints.end());
+}
+
 uint32_t
 OrdinalValues::
 getBucket(const CellValue & val) const
@@ -213,28 +371,9 @@ initialize(bool hasNulls,
     this->numeric.splits.clear();
 
     if (!numericValues.empty()) {
-        std::sort(numericValues.begin(), numericValues.end());
-        numericValues.erase(std::unique(numericValues.begin(),
-                                        numericValues.end()),
-                            numericValues.end());
-        std::vector<float> splitPoints;
-        std::vector<std::pair<float, float> > freqPairs;
-        for (auto & n: numericValues)
-            freqPairs.emplace_back(n, 1);
-        
-        BucketFreqs freqs(freqPairs.begin(), freqPairs.end());
-        
-        if (numBuckets != -1 && numericValues.size() > numBuckets) {
-            bucket_dist_reduced(splitPoints, freqs, numBuckets);
-        } else {
-            bucket_dist_full(splitPoints, freqs);
-        }
-
-        numericValues.clear();
-        numericValues.insert(numericValues.begin(),
-                             splitPoints.begin(), splitPoints.end());
         this->numeric.active = true;
-        this->numeric.splits = std::move(numericValues);
+        this->numeric.splits
+            = NumericValues::calcSplits(std::move(numericValues), numBuckets);
         n += this->numeric.splits.size() + 1;
     }
     
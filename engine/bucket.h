@@ -97,6 +97,11 @@ struct WritableBucketList: public BucketList {
         numWritten += 1;
     }
 
+    /** Write n bucket numbers at once, splitting the work across threads.
+        Must only be called without any writing having taken place.
+    */
+    void writeParallel(const uint32_t * values, size_t n);
+
     uint64_t * current;
     int bitsWritten;
     size_t numWritten;
@@ -121,6 +126,21 @@ struct NumericValues {
 
     uint32_t getBucket(double val) const;
 
+    /** Bucket numbers of n values at once, the same as calling getBucket()
+        for each.  A block of values is searched for in lockstep without
+        branches, which lets the compiler vectorize the search.
+    */
+    void getBuckets(const double * values, size_t n, uint32_t * buckets) const;
+
+    /** Return the split points between buckets for the given values,
+        targeting the given number of buckets (or one bucket per distinct
+        value for -1).  Large sets of values are reduced to a quantile
+        sketch in parallel rather than being sorted as a whole, which
+        gives approximate splits.
+    */
+    static std::vector<double>
+    calcSplits(std::vector<double> values, int numBuckets);
+
     void merge(const NumericValues & other);
 };
 
@@ -204,6 +224,10 @@ struct BucketDescriptions {
     
     /// Look up the bucket number for the given value
     uint32_t getBucket(const CellValue & val) const;
+
+    /// Look up the bucket numbers of n values, numbers a block at a time
+    void getBuckets(const CellValue * values, size_t n,
+                    uint32_t * buckets) const;
     CellValue getValue(uint32_t bucket) const;
     CellValue getSplit(uint32_t bucket) const;
     size_t numBuckets() const;
@@ -5,6 +5,7 @@
 
 #include "mldb/engine/column_scope.h"
 #include "mldb/sql/sql_expression_operations.h"
+#include "mldb/sql/sql_batch.h"
 #include "mldb/arch/timers.h"
 #include "mldb/base/parallel.h"
 #include "mldb/base/thread_pool.h"
@@ -68,6 +69,19 @@ doGetColumn(const Utf8String & tableName,
             std::make_shared<AtomValueInfo>()};
 }
 
+BatchColumnGetter
+ColumnScope::
+doGetColumnBatch(const Utf8String & tableName,
+                 const ColumnPath & columnName)
+{
+    return [=] (const SqlBatch & batch,
+                const SqlSelection & selection,
+                SqlBatchVector & out)
+        {
+            return batch.readColumn(columnName, selection, out);
+        };
+}
+
 GetAllColumnsOutput
 ColumnScope::
 doGetAllColumns(const Utf8String & tableName,
@@ -115,6 +129,188 @@ run(const std::vector<BoundSqlExpression> & exprs) const
 static const OptimizedPath optimizeRunIncremental
 ("mldb.ColumnScope.runIncremental");
 
+/// Same, for running expressions a column at a time in batch mode
+static const OptimizedPath optimizeRunBatches
+("mldb.ColumnScope.runBatches");
+
+namespace {
+
+/** A block of rows whose columns were extracted from a row stream, over
+    which expressions are executed in batch mode.
+*/
+struct ColumnBlockBatch: public SqlBatch {
+    ColumnBlockBatch(const ColumnScope & scope, size_t numRows,
+                     const SqlBatchVector * columns)
+        : SqlBatch(numRows), scope(scope), columns(columns)
+    {
+    }
+
+    const ColumnScope & scope;
+    const SqlBatchVector * columns;
+
+    virtual bool readColumn(const ColumnPath & columnName,
+                            const SqlSelection & selection,
+                            SqlBatchVector & out) const override
+    {
+        auto it = scope.requiredColumnIndexes.find(columnName);
+        if (it == scope.requiredColumnIndexes.end())
+            return false;
+        const SqlBatchVector & column = columns[it->second];
+
+        if (selection.size() == numRows) {
+            out = column;
+            return true;
+        }
+
+        switch (column.kind) {
+        case SqlBatchVector::INTEGER:
+            out.initIntegers(selection.size());  break;
+        case SqlBatchVector::DOUBLE:
+            out.initDoubles(selection.size());  break;
+        case SqlBatchVector::ATOM:
+            out.initAtoms(selection.size());  break;
+        }
+        for (size_t i = 0;  i < selection.size();  ++i)
+            out.set(i, column, selection[i]);
+        return true;
+    }
+
+    virtual ExpressionValue evalRow(const BoundSqlExpression & expr,
+                                    uint32_t row) const override
+    {
+        size_t nc = scope.requiredColumns.size();
+        PossiblyDynamicBuffer<CellValue> cellsHolder(nc);
+        CellValue * cells = cellsHolder.data();
+        for (size_t i = 0;  i < nc;  ++i)
+            cells[i] = columns[i].getCell(row);
+        return expr(ColumnScope::RowScope(cells), GET_LATEST);
+    }
+};
+
+/// Write the value of a batch for row i into out, as runIncremental() does
+static void extractBatchVal(const SqlBatchVector & vals, size_t i,
+                            CellValue & out)
+{
+    out = vals.getCell(i);
+}
+
+static void extractBatchVal(const SqlBatchVector & vals, size_t i,
+                            double & out)
+{
+    if (vals.isNull(i))
+        out = std::numeric_limits<double>::quiet_NaN();
+    else if (vals.isNumeric())
+        out = vals.getDouble(i);
+    else out = vals.atoms[i].toDouble();
+}
+
+/// Convert the values of a batch to numbers, with nulls as NaN
+template<typename Float>
+static void extractBatchFloats(const SqlBatchVector & vals, Float * out)
+{
+    size_t n = vals.size();
+    switch (vals.kind) {
+    case SqlBatchVector::INTEGER:
+        for (size_t i = 0;  i < n;  ++i)
+            out[i] = vals.ints[i];
+        break;
+    case SqlBatchVector::DOUBLE:
+        for (size_t i = 0;  i < n;  ++i)
+            out[i] = vals.doubles[i];
+        break;
+    case SqlBatchVector::ATOM:
+        for (size_t i = 0;  i < n;  ++i) {
+            out[i] = vals.atoms[i].empty()
+                ? std::numeric_limits<Float>::quiet_NaN()
+                : vals.atoms[i].toDouble();
+        }
+        return;
+    }
+
+    if (!vals.nulls.empty()) {
+        for (size_t i = 0;  i < n;  ++i) {
+            if (vals.nulls[i])
+                out[i] = std::numeric_limits<Float>::quiet_NaN();
+        }
+    }
+}
+
+} // file scope
+
+bool
+ColumnScope::
+canRunBatches(const std::vector<BoundSqlExpression> & exprs) const
+{
+    bool batchable = true;
+    for (auto & e: exprs)
+        batchable = batchable && isBatchable(e);
+
+    if (batchable) {
+        auto rowGen = dataset->generateRowsWhere(*this, "" /* alias */,
+                                                 *SqlExpression::TRUE,
+                                                 0 /* offset */,
+                                                 -1 /* limit */);
+        batchable = rowGen.rowStream
+            && rowGen.rowStream->supportsExtendedInterface();
+    }
+
+    return optimizeRunBatches(batchable);
+}
+
+bool
+ColumnScope::
+runBatches(const std::vector<BoundSqlExpression> & exprs,
+           std::function<bool (size_t startRow, size_t numRows,
+                               const SqlBatchVector * vals)> onBlock) const
+{
+    size_t numRows = dataset->getMatrixView()->getRowCount();
+
+    auto rowGen = dataset->generateRowsWhere(*this, "" /* alias */,
+                                             *SqlExpression::TRUE,
+                                             0 /* offset */,
+                                             -1 /* limit */);
+    ExcAssert(rowGen.rowStream);
+
+    std::vector<size_t> chunkOffsets;
+    auto chunks = rowGen.rowStream->parallelize(numRows,
+                                                RowStream::AUTO,
+                                                &chunkOffsets);
+
+    static constexpr size_t ROWS_AT_ONCE = 4096;
+
+    auto onChunk = [&] (size_t chunkNum)
+        {
+            RowStream & stream = *chunks[chunkNum];
+
+            std::vector<SqlBatchVector> columns(requiredColumns.size());
+            std::vector<SqlBatchVector> results(exprs.size());
+
+            size_t startOffset = chunkOffsets[chunkNum];
+            size_t endOffset = chunkOffsets[chunkNum + 1];
+
+            for (size_t startRow = startOffset;  startRow < endOffset;
+                 startRow += ROWS_AT_ONCE) {
+                size_t blockRows
+                    = std::min(ROWS_AT_ONCE, endOffset - startRow);
+
+                stream.extractColumnBatches(blockRows, requiredColumns,
+                                            columns.data());
+
+                ColumnBlockBatch batch(*this, blockRows, columns.data());
+                SqlSelection selection = selectAll(blockRows);
+                for (size_t j = 0;  j < exprs.size();  ++j)
+                    evalBatch(exprs[j], batch, selection, results[j]);
+
+                if (!onBlock(startRow, blockRows, results.data()))
+                    return false;
+            }
+
+            return true;
+        };
+
+    return parallelMapHaltable(0, chunks.size(), onChunk);
+}
+
 static void extractVals(size_t blockRows,
                         const std::vector<ColumnPath> & columnNames,
                         double * values, RowStream & stream)
@@ -194,6 +390,25 @@ runIncrementalT(const std::vector<BoundSqlExpression> & exprs,
     // Number of columns; for offset calculations
     size_t nc = requiredColumns.size();
 
+    if (canTakeOptimizedPath && canRunBatches(exprs)) {
+        auto onBlock = [&] (size_t startRow, size_t numRows,
+                            const SqlBatchVector * vals)
+            {
+                PossiblyDynamicBuffer<Val> resultsHolder(exprs.size());
+                Val * results = resultsHolder.data();
+
+                for (size_t r = 0;  r < numRows;  ++r) {
+                    for (size_t j = 0;  j < exprs.size();  ++j)
+                        extractBatchVal(vals[j], r, results[j]);
+                    if (!onVal(startRow + r, results))
+                        return false;
+                }
+                return true;
+            };
+
+        return runBatches(exprs, onBlock);
+    }
+
     if (optimizeRunIncremental(canTakeOptimizedPath)) {
         // No need to ever allocate a huge amount of memory
         std::vector<size_t> chunkOffsets;
@@ -334,6 +549,59 @@ runIncremental(const std::vector<BoundSqlExpression> & exprs,
     return runIncrementalT<CellValue>(exprs, onVal);
 }
 
+template<typename Float>
+std::vector<std::vector<Float> >
+ColumnScope::
+runFloatT(const std::vector<BoundSqlExpression> & exprs) const
+{
+    size_t numRows = dataset->getMatrixView()->getRowCount();
+
+    std::vector<std::vector<Float> > results(exprs.size());
+    for (auto & r: results)
+        r.resize(numRows);
+
+    if (canRunBatches(exprs)) {
+        auto onBlock = [&] (size_t startRow, size_t numRows,
+                            const SqlBatchVector * vals)
+            {
+                for (size_t j = 0;  j < exprs.size();  ++j)
+                    extractBatchFloats(vals[j], results[j].data() + startRow);
+                return true;
+            };
+
+        runBatches(exprs, onBlock);
+        return results;
+    }
+
+    auto onVal = [&] (size_t rowNum, CellValue * vals)
+        {
+            for (size_t j = 0;  j < exprs.size();  ++j) {
+                results[j][rowNum] = vals[j].empty()
+                    ? std::numeric_limits<Float>::quiet_NaN()
+                    : vals[j].toDouble();
+            }
+            return true;
+        };
+
+    runIncremental(exprs, onVal);
+
+    return results;
+}
+
+std::vector<std::vector<double> >
+ColumnScope::
+runDouble(const std::vector<BoundSqlExpression> & exprs) const
+{
+    return runFloatT<double>(exprs);
+}
+
+std::vector<std::vector<float> >
+ColumnScope::
+runFloat(const std::vector<BoundSqlExpression> & exprs) const
+{
+    return runFloatT<float>(exprs);
+}
+
 bool
 ColumnScope::
 runIncrementalDouble(const std::vector<BoundSqlExpression> & exprs,
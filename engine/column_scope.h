@@ -67,6 +67,10 @@ struct ColumnScope: public SqlExpressionMldbScope {
     doGetColumn(const Utf8String & tableName,
                 const ColumnPath & columnName);
 
+    virtual BatchColumnGetter
+    doGetColumnBatch(const Utf8String & tableName,
+                     const ColumnPath & columnName);
+
     /** This will throw, as the ColumnScope can't execute an expression
         with wildcards in it.
     */
@@ -140,7 +144,48 @@ struct ColumnScope: public SqlExpressionMldbScope {
                          std::function<bool (size_t rowNum,
                                              double * vals)> onVal) const;
 
+    /** Run the expressions, returning a contiguous array of doubles
+        for each of them with one element per row of the dataset.
+        Nulls are returned as NaN; any other value that isn't a number
+        causes an exception to be thrown.
+
+        When the dataset's row stream supports the extended interface,
+        the columns are extracted a block of rows at a time as typed
+        arrays, and the expressions are executed a column at a time in
+        batch mode (see sql_batch.h) without going through the row
+        scope; this is much faster for arithmetic and comparisons of
+        numeric columns.
+    */
+    std::vector<std::vector<double> >
+    runDouble(const std::vector<BoundSqlExpression> & exprs) const;
+
+    /** Same as runDouble(), but returns arrays of floats, which take half
+        of the memory for training data that doesn't need the precision.
+    */
+    std::vector<std::vector<float> >
+    runFloat(const std::vector<BoundSqlExpression> & exprs) const;
+
 private:
+    /** Run the expressions in batch mode over the dataset a block of
+        rows at a time, calling onBlock in parallel with the values of
+        each expression for the rows of each block.  Returns false if
+        and only if an onBlock call returned false.
+
+        This can only be used if canRunBatches() returns true.
+    */
+    bool
+    runBatches(const std::vector<BoundSqlExpression> & exprs,
+               std::function<bool (size_t startRow, size_t numRows,
+                                   const SqlBatchVector * vals)> onBlock)
+        const;
+
+    /// Can the expressions be run by runBatches()?
+    bool canRunBatches(const std::vector<BoundSqlExpression> & exprs) const;
+
+    template<typename Float>
+    std::vector<std::vector<Float> >
+    runFloatT(const std::vector<BoundSqlExpression> & exprs) const;
+
     template<typename Val>
     bool
     runIncrementalT(const std::vector<BoundSqlExpression> & exprs,
@@ -7,17 +7,21 @@
 
 */
 #include "mldb/engine/dataset_collection.h"
+#include "mldb/engine/dataset_row_stream.h"
 #include "mldb/rest/poly_collection_impl.h"
 #include "mldb/core/mldb_engine.h"
 #include "mldb/utils/string_functions.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/utils/lightweight_hash.h"
 #include "mldb/sql/sql_expression.h"
+#include "mldb/sql/arrow_writer.h"
+#include "mldb/sql/msgpack.h"
 #include "mldb/types/map_description.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/types/pair_description.h"
 #include "mldb/types/pointer_description.h"
 #include "mldb/types/tuple_description.h"
+#include "mldb/base/parallel.h"
 
 using namespace std;
 
@@ -56,10 +60,35 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                   bool createHeaders,
                   bool rowNames,
                   bool rowHashes,
-                  bool sortColumns)
+                  bool sortColumns,
+                  const RestParams & headers)
 {
     std::vector<MatrixNamedRow> sparseOutput = runQuery();
 
+    auto sendResult = [&] (std::string result)
+        {
+            if (headers.empty())
+                connection.sendResponse(200, std::move(result),
+                                        "application/json");
+            else connection.sendHttpResponse(200, std::move(result),
+                                             "application/json", headers);
+        };
+
+    if (isStreamingQueryFormat(format)) {
+        // Already in memory, but written the same way as when streamed
+        auto replay = [&] (std::function<bool (const RowPath &, RowValue &)> & onRow)
+            {
+                for (auto & row: sparseOutput) {
+                    if (!onRow(row.rowName, row.columns))
+                        return false;
+                }
+                return true;
+            };
+        runHttpQueryStreaming(replay, connection, format, createHeaders,
+                              rowNames, rowHashes, sortColumns);
+        return;
+    }
+
     if (sortColumns) {
         for (auto & r: sparseOutput) {
             std::sort(r.columns.begin(), r.columns.end());
@@ -67,8 +96,7 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
     }
 
     if (format == "full" || format == "") {
-        connection.sendResponse(200, jsonEncodeStr(sparseOutput),
-                                "application/json");
+        sendResult(jsonEncodeStr(sparseOutput));
     }
     else if (format == "sparse") {
         std::vector<std::vector<std::pair<ColumnPath, CellValue> > > output;
@@ -93,8 +121,7 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
             output.emplace_back(std::move(rowOut));
         }
 
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
+        sendResult(jsonEncodeStr(output));
     }
     else if (format == "soa") {
         // Structure of arrays; one array per column
@@ -117,8 +144,7 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                 vals[i] = val;
             }
         }
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
+        sendResult(jsonEncodeStr(output));
     }
     else if (format == "aos") {
         // Array of structures; one structure per row
@@ -140,8 +166,7 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
 
             output.emplace_back(std::move(row));
         }
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
+        sendResult(jsonEncodeStr(output));
     }
     else if (format == "table") {
         // TODO: the SQL knows what columns could be created... this could
@@ -231,8 +256,7 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
             output.push_back(rowOut);
         }
 
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
+        sendResult(jsonEncodeStr(output));
     }
     else if (format == "atom") {
         if (sparseOutput.size() > 1) {
@@ -259,14 +283,291 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
 
         const auto& val = std::get<1>(columns[0]);
 
-        connection.sendResponse(200, jsonEncodeStr(val),
-                                "application/json"); 
+        sendResult(jsonEncodeStr(val)); 
     }
     else {
         connection.sendErrorResponse(400, "Unknown output format '" + format + "'");
     }
 }
 
+bool isStreamingQueryFormat(const std::string & format)
+{
+    return format == "jsonl" || format == "csv" || format == "arrow";
+}
+
+namespace {
+
+// Append a CSV field, quoting it if needed
+void appendCsvField(std::string & out, const std::string & field)
+{
+    if (field.find_first_of(",\"\r\n") == std::string::npos) {
+        out += field;
+        return;
+    }
+    out += '"';
+    for (char c: field) {
+        if (c == '"')
+            out += '"';
+        out += c;
+    }
+    out += '"';
+}
+
+std::string csvCellString(const CellValue & val)
+{
+    if (val.empty())
+        return std::string();
+    if (val.isPath())
+        return val.coerceToPath().toUtf8String().rawString();
+    return val.toUtf8String().rawString();
+}
+
+} // file scope
+
+void runHttpQueryStreaming
+    (std::function<bool (std::function<bool (const RowPath &, RowValue &)> &)>
+         runQuery,
+     RestConnection & connection,
+     const std::string & format,
+     bool createHeaders,
+     bool rowNames,
+     bool rowHashes,
+     bool sortColumns)
+{
+    /// Output is sent once this much has been buffered
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    /// The query waits while more than this is waiting to be sent
+    static constexpr size_t MAX_PENDING = 16 * CHUNK_SIZE;
+
+    /// Number of rows whose columns make up the CSV header or the Arrow
+    /// schema
+    static constexpr size_t CSV_HEADER_ROWS = 1000;
+
+    /// Number of rows in each Arrow record batch after the first
+    static constexpr size_t ARROW_BATCH_ROWS = 16384;
+
+    bool csv = format == "csv";
+    bool arrow = format == "arrow";
+    std::string buffer;
+    bool headerSent = false;
+    bool stopped = false;
+
+    // Send what's buffered, and wait if the other end is behind.  Returns
+    // false if the connection has gone away.
+    auto flush = [&] ()
+        {
+            if (!headerSent) {
+                connection.sendHttpResponseHeader
+                    (200,
+                     csv ? "text/csv"
+                     : arrow ? "application/vnd.apache.arrow.stream"
+                     : "application/x-ndjson",
+                     RestConnection::CHUNKED_ENCODING);
+                headerSent = true;
+            }
+            if (!buffer.empty()) {
+                connection.sendPayload(std::move(buffer));
+                buffer = std::string();
+            }
+            return connection.waitForPendingPayload(MAX_PENDING);
+        };
+
+    // For CSV and Arrow, the rows are held until the columns are known
+    std::vector<ColumnPath> columns;
+    LightweightHash<ColumnHash, int> columnIndex;
+    std::vector<std::pair<RowPath, RowValue> > heldRows;
+    bool columnsKnown = !csv && !arrow;
+    std::unique_ptr<ArrowWriter> arrowWriter;
+
+    auto writeRow = [&] (const RowPath & rowName, RowValue & row)
+        {
+            if (!csv && !arrow) {
+                std::map<ColumnPath, CellValue> output;
+                if (rowNames)
+                    output[ColumnPath("_rowName")] = rowName.toUtf8String();
+                if (rowHashes)
+                    output[ColumnPath("_rowHash")] = RowHash(rowName).toString();
+                for (auto & c: row)
+                    output[std::get<0>(c)] = std::move(std::get<1>(c));
+                buffer += jsonEncodeStr(output);
+                buffer += '\n';
+                return;
+            }
+
+            std::vector<const CellValue *> values(columns.size(), nullptr);
+            for (auto & c: row) {
+                auto it = columnIndex.find(std::get<0>(c));
+                if (it == columnIndex.end())
+                    throw AnnotatedException
+                        (400, "Column '" + std::get<0>(c).toUtf8String()
+                         + "' first appeared after the rows used for the "
+                         + (csv ? "CSV header" : "Arrow schema")
+                         + "; use the 'jsonl' format for queries whose "
+                         "columns vary between rows",
+                         "column", std::get<0>(c));
+                values[it->second] = &std::get<1>(c);
+            }
+
+            if (arrow) {
+                CellValue name, hash;
+                std::vector<const CellValue *> arrowValues;
+                if (rowNames) {
+                    name = rowName.toUtf8String();
+                    arrowValues.push_back(&name);
+                }
+                if (rowHashes) {
+                    hash = RowHash(rowName).toString();
+                    arrowValues.push_back(&hash);
+                }
+                arrowValues.insert(arrowValues.end(),
+                                   values.begin(), values.end());
+                arrowWriter->addRow(arrowValues.data());
+                return;
+            }
+
+            bool first = true;
+            auto sep = [&] () { if (!first) buffer += ',';  first = false; };
+            if (rowNames) {
+                sep();
+                appendCsvField(buffer, rowName.toUtf8String().rawString());
+            }
+            if (rowHashes) {
+                sep();
+                buffer += RowHash(rowName).toString();
+            }
+            for (auto * v: values) {
+                sep();
+                if (v)
+                    appendCsvField(buffer, csvCellString(*v));
+            }
+            buffer += "\r\n";
+        };
+
+    // Fix the CSV or Arrow columns from the rows held so far and write
+    // them out
+    auto startTable = [&] ()
+        {
+            for (auto & r: heldRows) {
+                for (auto & c: r.second) {
+                    auto & columnName = std::get<0>(c);
+                    if (columnIndex.insert({columnName, columns.size()}).second)
+                        columns.push_back(columnName);
+                }
+            }
+
+            if (sortColumns) {
+                std::sort(columns.begin(), columns.end());
+                for (size_t i = 0;  i < columns.size();  ++i)
+                    columnIndex[columns[i]] = i;
+            }
+
+            if (arrow) {
+                std::vector<ArrowField> fields;
+                if (rowNames)
+                    fields.push_back({ "_rowName", ArrowType::UTF8 });
+                if (rowHashes)
+                    fields.push_back({ "_rowHash", ArrowType::UTF8 });
+                for (auto & c: columns)
+                    fields.push_back({ c.toUtf8String(), ArrowType::NONE });
+                arrowWriter.reset
+                    (new ArrowWriter(std::move(fields),
+                                     [&] (std::string data) { buffer += data; },
+                                     false /* fileFormat */,
+                                     ARROW_BATCH_ROWS));
+            }
+            else if (createHeaders) {
+                bool first = true;
+                auto sep = [&] () { if (!first) buffer += ',';  first = false; };
+                if (rowNames) {
+                    sep();
+                    buffer += "_rowName";
+                }
+                if (rowHashes) {
+                    sep();
+                    buffer += "_rowHash";
+                }
+                for (auto & c: columns) {
+                    sep();
+                    appendCsvField(buffer, c.toUtf8String().rawString());
+                }
+                buffer += "\r\n";
+            }
+
+            columnsKnown = true;
+            for (auto & r: heldRows)
+                writeRow(r.first, r.second);
+            heldRows.clear();
+
+            // The types of the Arrow columns are chosen from the held rows,
+            // which are sent straight away
+            if (arrow)
+                arrowWriter->flush();
+        };
+
+    std::function<bool (const RowPath &, RowValue &)> onRow
+        = [&] (const RowPath & rowName, RowValue & row)
+        {
+            if (!columnsKnown) {
+                heldRows.emplace_back(rowName, std::move(row));
+                if (heldRows.size() < CSV_HEADER_ROWS)
+                    return true;
+                startTable();
+            }
+            else {
+                if (sortColumns)
+                    std::sort(row.begin(), row.end());
+                writeRow(rowName, row);
+            }
+
+            // The first rows are sent straight away so that the client
+            // sees output as soon as possible
+            if (!headerSent || buffer.size() >= CHUNK_SIZE) {
+                if (!flush()) {
+                    stopped = true;
+                    return false;
+                }
+            }
+            return true;
+        };
+
+    try {
+        runQuery(onRow);
+        if (!columnsKnown)
+            startTable();
+        if (arrow)
+            arrowWriter->finish();
+    } catch (const std::exception & exc) {
+        // Before anything is sent, the error is returned normally
+        if (!headerSent)
+            throw;
+
+        int httpCode = 500;
+        if (auto annotated = dynamic_cast<const AnnotatedException *>(&exc))
+            httpCode = annotated->httpCode;
+
+        if (arrow) {
+            arrowWriter->finishWithError(exc.what(), httpCode);
+        }
+        else if (csv) {
+            buffer += "#error,";
+            appendCsvField(buffer, exc.what());
+            buffer += "\r\n";
+        }
+        else {
+            Json::Value error;
+            error["error"] = exc.what();
+            error["httpCode"] = httpCode;
+            buffer += error.toStringNoNewLine();
+            buffer += '\n';
+        }
+    }
+
+    if (!stopped && (!buffer.empty() || !headerSent))
+        flush();
+    connection.finishResponse();
+}
+
 
 /*****************************************************************************/
 /* DATASET COLLECTION                                                        */
@@ -274,7 +575,13 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
 
 DatasetCollection::
 DatasetCollection(MldbEngine * engine)
-    : PolyCollection<Dataset>(L"dataset", L"datasets", engine->getDirectory())
+    : PolyCollection<Dataset>(L"dataset", L"datasets", engine->getDirectory()),
+      rowStreams(new DatasetRowStreams())
+{
+}
+
+DatasetCollection::
+~DatasetCollection()
 {
 }
 
@@ -311,7 +618,8 @@ initRoutes(RouteManager & manager)
 
     addRouteSync(*manager.valueNode, "/commit", { "POST" },
                  "Commit dataset",
-                 &Dataset::commit,
+                 &DatasetCollection::commitDataset,
+                 manager.getCollection,
                  getDataset);
 
     addRouteSyncJsonReturn(*manager.valueNode, "/timestampRange", { "GET" },
@@ -383,6 +691,85 @@ initRoutes(RouteManager & manager)
                  JsonParam<std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > >
                  ("", "[ [ row name, [ [ column name, value, timestamp ], ... ] ], ...] tuples to record"));
 
+    /************************
+     *      /rowstream
+     * ***************/
+
+    auto getCollection = manager.getCollection;
+
+    RestRequestRouter::OnProcessRequest handleRowStream
+        = [=] (RestConnection & connection,
+               const RestRequest & req,
+               const RestRequestParsingContext & cxt)
+        {
+            try {
+                MLDB_TRACE_EXCEPTIONS(false);
+
+                auto collection = static_cast<DatasetCollection *>
+                    (getCollection(cxt));
+                auto dataset = std::static_pointer_cast<Dataset>
+                    (cxt.getSharedPtrAs<PolyEntity>(2));
+
+                if (req.verb == "GET") {
+                    auto stream = collection->rowStreams->find(dataset.get());
+                    Json::Value status;
+                    if (stream)
+                        status = stream->getStatus();
+                    else status["config"] = jsonEncode(RowStreamConfig());
+                    connection.sendHttpResponse(200, status.toStringNoNewLine(),
+                                                "application/json", {});
+                    return RestRequestRouter::MR_YES;
+                }
+
+                auto stream = collection->rowStreams->get(dataset);
+
+                if (req.verb == "PUT") {
+                    stream->setConfig
+                        (jsonDecodeStr<RowStreamConfig>(req.payload));
+                    connection.sendHttpResponse
+                        (200, stream->getStatus().toStringNoNewLine(),
+                         "application/json", {});
+                    return RestRequestRouter::MR_YES;
+                }
+
+                const std::string & contentType = req.header.contentType;
+                std::vector<StreamedRow> rowsIn;
+                if (contentType == MSGPACK_CONTENT_TYPE
+                    || contentType == "application/x-msgpack")
+                    rowsIn = parseMsgPackRows(req.payload);
+                else rowsIn = parseNdjsonRows(req.payload);
+
+                Json::Value result;
+                result["rows"] = rowsIn.size();
+
+                stream->record(std::move(rowsIn));
+                if (getParam(req, "flush", false))
+                    stream->flush();
+
+                connection.sendHttpResponse(200, result.toStringNoNewLine(),
+                                            "application/json", {});
+                return RestRequestRouter::MR_YES;
+            } catch (const AnnotatedException & exc) {
+                return sendExceptionResponse(connection, exc);
+            } catch (const std::exception & exc) {
+                return sendExceptionResponse(connection, exc);
+            }
+        };
+
+    manager.valueNode->addRoute("/rowstream", { "POST" },
+                                "Stream newline-delimited JSON or MessagePack "
+                                "rows into the dataset, to be recorded in "
+                                "batches",
+                                handleRowStream, help);
+    manager.valueNode->addRoute("/rowstream", { "PUT" },
+                                "Configure how rows streamed into the dataset "
+                                "are batched",
+                                handleRowStream, help);
+    manager.valueNode->addRoute("/rowstream", { "GET" },
+                                "Get the configuration and counters of the "
+                                "rows streamed into the dataset",
+                                handleRowStream, help);
+
     auto & row MLDB_UNUSED
         = rows.addSubRouter(Rx("/([0-9a-z]{16})", "/<rowHash>"),
                             "operations on an individual row");
@@ -518,6 +905,16 @@ initRoutes(RouteManager & manager)
 
 }
 
+void
+DatasetCollection::
+commitDataset(Dataset * dataset)
+{
+    auto stream = rowStreams->find(dataset);
+    if (stream)
+        stream->flush();
+    dataset->commit();
+}
+
 std::vector<std::pair<CellValue, int64_t> >
 DatasetCollection::
 getColumnValueCounts(const Dataset * dataset,
@@ -585,6 +982,7 @@ queryStructured(const Dataset * dataset,
                  groupByParsed,havingParsed, rowNameParsed, offset, limit);
         };
 
+    ParallelismScope parallelism;
     runHttpQuery(runQuery, connection, format, createHeaders,rowNames, rowHashes, sortColumns);
 }
 
@@ -26,6 +26,8 @@ namespace MLDB {
     - createHeaders: table result formats will include a header row
     - rowNames: add a '_rowName' column
     - rowHashes: add a '_rowHash' column
+    - headers: extra HTTP headers to send with the results.  These are
+      not sent for the streamed formats.
 */
 void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                   RestConnection & connection,
@@ -33,16 +35,55 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                   bool createHeaders,
                   bool rowNames,
                   bool rowHashes,
-                  bool sortColumns);
-                      
+                  bool sortColumns,
+                  const RestParams & headers = RestParams());
+
+/** Is the given query output format one that is streamed by
+    runHttpQueryStreaming(), rather than buffered in memory?  These are
+    "jsonl" (one JSON object per line), "csv" and "arrow" (an Arrow IPC
+    stream).
+*/
+bool isStreamingQueryFormat(const std::string & format);
+
+/** Run a query (by calling the given function, which calls the row
+    callback it's passed once per row, and stops if it returns false) and
+    stream the results over HTTP in the given format as they are produced,
+    using chunked transfer encoding.
+
+    The output is sent in chunks of around 64kb; if the other end reads
+    them more slowly than the query produces them, the query is made to
+    wait.  If the connection is closed the query is stopped.
+
+    An error before any output has been sent is thrown as usual; after
+    that, the headers have already gone, so it's written as the last
+    record of the output instead.
+
+    For the "csv" and "arrow" formats, the columns are those of the first
+    1000 rows; a column that first appears after that is an error.  The
+    types of the Arrow columns are also chosen from those rows.
+*/
+void runHttpQueryStreaming
+    (std::function<bool (std::function<bool (const RowPath &, RowValue &)> &)>
+         runQuery,
+     RestConnection & connection,
+     const std::string & format,
+     bool createHeaders,
+     bool rowNames,
+     bool rowHashes,
+     bool sortColumns);
+
 
 /*****************************************************************************/
 /* DATASET COLLECTION                                                        */
 /*****************************************************************************/
 
+struct DatasetRowStreams;
+
 struct DatasetCollection: public PolyCollection<Dataset> {
     DatasetCollection(MldbEngine * engine);
 
+    ~DatasetCollection();
+
     static void initRoutes(RouteManager & manager);
 
     virtual Any getEntityStatus(const Dataset & dataset) const;
@@ -71,6 +112,16 @@ struct DatasetCollection: public PolyCollection<Dataset> {
                     bool rowNames,
                     bool rowHashes,
                     bool sortColumns) const;
+
+    /** Commit the dataset, after recording the rows that were streamed
+        into it and are still buffered.
+    */
+    void commitDataset(Dataset * dataset);
+
+    /** Rows streamed into the datasets, waiting to be recorded in
+        batches.
+    */
+    std::unique_ptr<DatasetRowStreams> rowStreams;
 };
 
 extern template class PolyCollection<Dataset>;
@@ -0,0 +1,505 @@
+/** dataset_row_stream.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Micro-batching of rows that are streamed into a dataset.
+*/
+
+#include "dataset_row_stream.h"
+#include "mldb/sql/msgpack.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/types/tuple_description.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/pair_description.h"
+#include <algorithm>
+#include <cstring>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ROW STREAM CONFIG                                                         */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(RowStreamConfig);
+
+RowStreamConfigDescription::
+RowStreamConfigDescription()
+{
+    addField("maxBatchRows", &RowStreamConfig::maxBatchRows,
+             "Number of rows that are buffered before they are recorded "
+             "together into the dataset.", 10000);
+    addField("maxBatchLatencySeconds", &RowStreamConfig::maxBatchLatencySeconds,
+             "Longest time in seconds that a row waits in the buffer before "
+             "it is recorded into the dataset.", 0.1);
+    addField("maxPendingRows", &RowStreamConfig::maxPendingRows,
+             "Number of rows that may be buffered or being recorded before "
+             "new rows have to wait for room.", 1000000);
+    addField("maxWaitSeconds", &RowStreamConfig::maxWaitSeconds,
+             "Longest time in seconds that new rows wait for room before "
+             "they are rejected with a 503 error.", 5.0);
+    addField("commitBatches", &RowStreamConfig::commitBatches,
+             "Commit the dataset after each batch is recorded, so that "
+             "streamed rows can be queried once their batch is recorded.",
+             false);
+
+    onPostValidate = [] (RowStreamConfig * config,
+                         JsonParsingContext & context)
+        {
+            if (config->maxBatchRows < 1)
+                throw AnnotatedException(400, "maxBatchRows must be at "
+                                         "least 1",
+                                         "maxBatchRows", config->maxBatchRows);
+            if (config->maxBatchLatencySeconds <= 0)
+                throw AnnotatedException(400, "maxBatchLatencySeconds must "
+                                         "be positive",
+                                         "maxBatchLatencySeconds",
+                                         config->maxBatchLatencySeconds);
+            if (config->maxPendingRows < config->maxBatchRows)
+                throw AnnotatedException(400, "maxPendingRows must be at "
+                                         "least maxBatchRows",
+                                         "maxPendingRows",
+                                         config->maxPendingRows,
+                                         "maxBatchRows",
+                                         config->maxBatchRows);
+            if (config->maxWaitSeconds < 0)
+                throw AnnotatedException(400, "maxWaitSeconds must not be "
+                                         "negative",
+                                         "maxWaitSeconds",
+                                         config->maxWaitSeconds);
+        };
+}
+
+
+/*****************************************************************************/
+/* DATASET ROW STREAM                                                        */
+/*****************************************************************************/
+
+DatasetRowStream::
+DatasetRowStream(std::shared_ptr<Dataset> dataset,
+                 std::function<void ()> onBuffered)
+    : dataset(dataset), onBuffered(std::move(onBuffered)),
+      inFlightRows(0), inFlightBatches(0),
+      rowsReceived(0), rowsRecorded(0), rowsDropped(0),
+      batchesRecorded(0), numRejected(0)
+{
+}
+
+DatasetRowStream::
+~DatasetRowStream()
+{
+}
+
+void
+DatasetRowStream::
+setConfig(const RowStreamConfig & newConfig)
+{
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        config = newConfig;
+    }
+    changed.notify_all();
+    if (onBuffered)
+        onBuffered();
+}
+
+RowStreamConfig
+DatasetRowStream::
+getConfig() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    return config;
+}
+
+bool
+DatasetRowStream::
+isFor(const Dataset * ds) const
+{
+    return dataset.lock().get() == ds;
+}
+
+void
+DatasetRowStream::
+record(std::vector<StreamedRow> rows)
+{
+    if (rows.empty())
+        return;
+
+    std::unique_lock<std::mutex> guard(mutex);
+
+    // Wait for room, unless nothing is pending, in which case even a
+    // request that's bigger than the limit is let through
+    auto pending = [&] () { return buffered.size() + inFlightRows; };
+    Date deadline = Date::now().plusSeconds(config.maxWaitSeconds);
+    while (pending() > 0
+           && pending() + rows.size() > (size_t)config.maxPendingRows) {
+        double waitSeconds = deadline.secondsSince(Date::now());
+        if (waitSeconds <= 0) {
+            ++numRejected;
+            throw AnnotatedException
+                (503, "Too many rows are waiting to be recorded into the "
+                 "dataset; retry later",
+                 "pendingRows", pending(),
+                 "maxPendingRows", config.maxPendingRows);
+        }
+        changed.wait_for(guard, std::chrono::duration<double>(waitSeconds));
+    }
+
+    rowsReceived += rows.size();
+
+    bool wasEmpty = buffered.empty();
+    if (wasEmpty) {
+        oldestBuffered = Date::now();
+        buffered = std::move(rows);
+    }
+    else {
+        buffered.insert(buffered.end(),
+                        std::make_move_iterator(rows.begin()),
+                        std::make_move_iterator(rows.end()));
+    }
+
+    if (buffered.size() >= (size_t)config.maxBatchRows) {
+        recordBuffered(guard);
+    }
+    else if (wasEmpty) {
+        // The flusher needs to know when these become due
+        guard.unlock();
+        if (onBuffered)
+            onBuffered();
+    }
+}
+
+void
+DatasetRowStream::
+recordBuffered(std::unique_lock<std::mutex> & guard)
+{
+    std::vector<StreamedRow> batch;
+    batch.swap(buffered);
+    bool commit = config.commitBatches;
+
+    inFlightRows += batch.size();
+    ++inFlightBatches;
+    guard.unlock();
+
+    std::exception_ptr error;
+    try {
+        auto ds = dataset.lock();
+        if (ds) {
+            ds->recordRows(batch);
+            if (commit)
+                ds->commit();
+        }
+        guard.lock();
+        if (ds) {
+            rowsRecorded += batch.size();
+            ++batchesRecorded;
+        }
+        else rowsDropped += batch.size();
+    } catch (const std::exception & exc) {
+        error = std::current_exception();
+        guard.lock();
+        rowsDropped += batch.size();
+        lastError = exc.what();
+    }
+
+    inFlightRows -= batch.size();
+    --inFlightBatches;
+    changed.notify_all();
+
+    if (error) {
+        guard.unlock();
+        std::rethrow_exception(error);
+    }
+}
+
+void
+DatasetRowStream::
+flush()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    if (!buffered.empty())
+        recordBuffered(guard);
+    changed.wait(guard, [&] () { return inFlightBatches == 0; });
+}
+
+void
+DatasetRowStream::
+flushIfDue(Date now)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    if (buffered.empty()
+        || now < oldestBuffered.plusSeconds(config.maxBatchLatencySeconds))
+        return;
+    try {
+        recordBuffered(guard);
+    } catch (const std::exception & exc) {
+        // It's in lastError; there is nobody else to tell
+    }
+}
+
+Date
+DatasetRowStream::
+nextDue() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    if (buffered.empty())
+        return Date::positiveInfinity();
+    return oldestBuffered.plusSeconds(config.maxBatchLatencySeconds);
+}
+
+Json::Value
+DatasetRowStream::
+getStatus() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    Json::Value result;
+    result["config"] = jsonEncode(config);
+    result["rowsBuffered"] = buffered.size();
+    result["rowsInFlight"] = inFlightRows;
+    result["rowsReceived"] = rowsReceived;
+    result["rowsRecorded"] = rowsRecorded;
+    result["rowsDropped"] = rowsDropped;
+    result["batchesRecorded"] = batchesRecorded;
+    result["numRejected"] = numRejected;
+    if (!lastError.empty())
+        result["lastError"] = lastError;
+    return result;
+}
+
+
+/*****************************************************************************/
+/* DATASET ROW STREAMS                                                       */
+/*****************************************************************************/
+
+DatasetRowStreams::
+DatasetRowStreams()
+    : shutdown(false)
+{
+}
+
+DatasetRowStreams::
+~DatasetRowStreams()
+{
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        shutdown = true;
+    }
+    changed.notify_all();
+    if (flusher.joinable())
+        flusher.join();
+}
+
+std::shared_ptr<DatasetRowStream>
+DatasetRowStreams::
+get(const std::shared_ptr<Dataset> & dataset)
+{
+    ExcAssert(dataset);
+
+    std::unique_lock<std::mutex> guard(mutex);
+
+    auto & stream = streams[dataset.get()];
+
+    // A deleted dataset may have left its stream behind at the same address
+    if (!stream || !stream->isFor(dataset.get())) {
+        stream = std::make_shared<DatasetRowStream>
+            (dataset, [this] () { changed.notify_all(); });
+    }
+
+    if (!flusher.joinable())
+        flusher = std::thread([this] () { runFlusher(); });
+
+    return stream;
+}
+
+std::shared_ptr<DatasetRowStream>
+DatasetRowStreams::
+find(const Dataset * dataset) const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    auto it = streams.find(dataset);
+    if (it == streams.end() || !it->second->isFor(dataset))
+        return nullptr;
+    return it->second;
+}
+
+void
+DatasetRowStreams::
+runFlusher()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    while (!shutdown) {
+        std::vector<std::shared_ptr<DatasetRowStream> > toCheck;
+        for (auto it = streams.begin();  it != streams.end();) {
+            if (it->second->expired())
+                it = streams.erase(it);
+            else toCheck.push_back((it++)->second);
+        }
+
+        // Record with the lock released, so that new streams can be
+        // created in the meantime
+        guard.unlock();
+        Date now = Date::now();
+        Date nextDue = Date::positiveInfinity();
+        for (auto & s: toCheck) {
+            s->flushIfDue(now);
+            nextDue = std::min(nextDue, s->nextDue());
+        }
+        toCheck.clear();
+        guard.lock();
+
+        if (shutdown)
+            break;
+
+        // Streams call changed.notify_all() when rows arrive in an empty
+        // buffer, but that may have happened while the lock was released,
+        // so never sleep for too long
+        double waitSeconds = std::min(1.0, nextDue.secondsSince(Date::now()));
+        if (waitSeconds > 0)
+            changed.wait_for(guard, std::chrono::duration<double>(waitSeconds));
+    }
+}
+
+
+/*****************************************************************************/
+/* PARSING                                                                   */
+/*****************************************************************************/
+
+std::vector<StreamedRow>
+parseNdjsonRows(const std::string & payload)
+{
+    // Find the lines
+    std::vector<std::pair<const char *, const char *> > lines;
+    const char * p = payload.data();
+    const char * e = p + payload.size();
+    while (p < e) {
+        const char * eol = (const char *)memchr(p, '\n', e - p);
+        if (!eol)
+            eol = e;
+        lines.emplace_back(p, eol);
+        p = eol + 1;
+    }
+
+    std::vector<StreamedRow> rows(lines.size());
+    std::vector<bool> present(lines.size());
+
+    static constexpr size_t LINES_PER_BLOCK = 1024;
+    size_t numBlocks = (lines.size() + LINES_PER_BLOCK - 1) / LINES_PER_BLOCK;
+
+    auto doBlock = [&] (size_t block)
+        {
+            size_t end = std::min(lines.size(), (block + 1) * LINES_PER_BLOCK);
+            for (size_t i = block * LINES_PER_BLOCK;  i < end;  ++i) {
+                const char * start = lines[i].first;
+                const char * finish = lines[i].second;
+                while (start < finish && isspace(*start))
+                    ++start;
+                while (finish > start && isspace(finish[-1]))
+                    --finish;
+                if (start == finish)
+                    continue;
+                try {
+                    rows[i] = jsonDecodeStr<StreamedRow>(start, finish - start);
+                } catch (const std::exception & exc) {
+                    throw AnnotatedException
+                        (400, "Error parsing streamed row: "
+                         + string(exc.what()),
+                         "lineNumber", i + 1);
+                }
+                present[i] = true;
+            }
+        };
+
+    // Small bodies aren't worth the overhead of going parallel
+    if (numBlocks <= 1) {
+        for (size_t i = 0;  i < numBlocks;  ++i)
+            doBlock(i);
+    }
+    else parallelMap(0, numBlocks, doBlock);
+
+    // Remove blank lines
+    size_t n = 0;
+    for (size_t i = 0;  i < rows.size();  ++i) {
+        if (!present[i])
+            continue;
+        if (n != i)
+            rows[n] = std::move(rows[i]);
+        ++n;
+    }
+    rows.resize(n);
+
+    return rows;
+}
+
+namespace {
+
+Path readMsgPackPath(MsgPackReader & reader)
+{
+    CellValue val = reader.readAtom();
+    if (val.isString())
+        return Path::parse(val.toUtf8String());
+    if (val.isInteger())
+        return PathElement(val.toInt());
+    throw AnnotatedException(400, "Row and column names in MessagePack rows "
+                             "must be strings or integers",
+                             "value", val);
+}
+
+Date readMsgPackTimestamp(MsgPackReader & reader)
+{
+    CellValue val = reader.readAtom();
+    if (val.isTimestamp())
+        return val.toTimestamp();
+    if (val.isNumber())
+        return Date::fromSecondsSinceEpoch(val.toDouble());
+    if (val.isString())
+        return jsonDecode<Date>(Json::Value(val.toString()));
+    throw AnnotatedException(400, "Timestamps in MessagePack rows must be "
+                             "timestamps, numbers or strings",
+                             "value", val);
+}
+
+} // file scope
+
+std::vector<StreamedRow>
+parseMsgPackRows(const std::string & payload)
+{
+    std::vector<StreamedRow> rows;
+    MsgPackReader reader(payload);
+
+    auto expectArray = [&] (size_t expected)
+        {
+            size_t n = reader.readArray();
+            if (n != expected)
+                throw AnnotatedException
+                    (400, "MessagePack rows must be [ row name, [ [ column "
+                     "name, value, timestamp ], ... ] ]",
+                     "rowNumber", rows.size() + 1);
+        };
+
+    while (!reader.eof()) {
+        StreamedRow row;
+        expectArray(2);
+        row.first = readMsgPackPath(reader);
+        size_t numColumns = reader.readArray();
+        row.second.reserve(numColumns);
+        for (size_t i = 0;  i < numColumns;  ++i) {
+            expectArray(3);
+            ColumnPath column = readMsgPackPath(reader);
+            CellValue value = reader.readAtom();
+            Date ts = readMsgPackTimestamp(reader);
+            row.second.emplace_back(std::move(column), std::move(value), ts);
+        }
+        rows.emplace_back(std::move(row));
+    }
+
+    return rows;
+}
+
+} // namespace MLDB
@@ -0,0 +1,187 @@
+/** dataset_row_stream.h                                            -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Micro-batching of rows that are streamed into a dataset.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include "mldb/types/date.h"
+#include "mldb/types/value_description_fwd.h"
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+
+namespace MLDB {
+
+/// A row as it's passed to Dataset::recordRows()
+typedef std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > >
+StreamedRow;
+
+
+/*****************************************************************************/
+/* ROW STREAM CONFIG                                                         */
+/*****************************************************************************/
+
+/** How the rows streamed into a dataset are batched. */
+
+struct RowStreamConfig {
+    /// Rows that are buffered before they're recorded together
+    int maxBatchRows = 10000;
+
+    /// Longest time that a row waits in the buffer before it's recorded
+    double maxBatchLatencySeconds = 0.1;
+
+    /// Rows that may be buffered or being recorded before new ones wait
+    int maxPendingRows = 1000000;
+
+    /// Longest time that new rows wait for room before they're rejected
+    double maxWaitSeconds = 5.0;
+
+    /// Commit the dataset after recording each batch
+    bool commitBatches = false;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(RowStreamConfig);
+
+
+/*****************************************************************************/
+/* DATASET ROW STREAM                                                        */
+/*****************************************************************************/
+
+/** Buffer of the rows streamed into one dataset.  Rows accumulate until
+    there are maxBatchRows of them, at which point the thread that added
+    the last one records the whole batch with a single recordRows() call,
+    or until the oldest has waited maxBatchLatencySeconds, at which point
+    a background thread records them.
+
+    Once maxPendingRows rows are buffered or being recorded, new rows wait
+    for room, and are rejected with a 503 error if there is still none
+    after maxWaitSeconds, so that producers back off instead of the buffer
+    growing without limit.
+
+    The stream only holds a weak reference to its dataset; rows that are
+    streamed into a dataset that has been deleted are dropped.
+*/
+
+struct DatasetRowStream {
+    DatasetRowStream(std::shared_ptr<Dataset> dataset,
+                     std::function<void ()> onBuffered);
+
+    ~DatasetRowStream();
+
+    void setConfig(const RowStreamConfig & config);
+
+    RowStreamConfig getConfig() const;
+
+    /** Add rows to the buffer, waiting for room if needed, and record the
+        batch if it's full.  An error recording the batch is rethrown.
+    */
+    void record(std::vector<StreamedRow> rows);
+
+    /** Record whatever is buffered, and wait until the batches that other
+        threads are recording are done, so that everything streamed before
+        the call is in the dataset.
+    */
+    void flush();
+
+    /** Record the buffered rows if the oldest has waited long enough.
+        Errors are kept in the status rather than thrown.
+    */
+    void flushIfDue(Date now);
+
+    /** When the buffered rows will be due to be recorded, or
+        Date::positiveInfinity() if nothing is buffered.
+    */
+    Date nextDue() const;
+
+    /// Is the dataset still alive?
+    bool expired() const { return dataset.expired(); }
+
+    /// Is this the stream of the given dataset?
+    bool isFor(const Dataset * dataset) const;
+
+    Json::Value getStatus() const;
+
+private:
+    std::weak_ptr<Dataset> dataset;
+    std::function<void ()> onBuffered;
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    RowStreamConfig config;
+    std::vector<StreamedRow> buffered;
+    Date oldestBuffered;
+    size_t inFlightRows;
+    int inFlightBatches;
+
+    uint64_t rowsReceived;
+    uint64_t rowsRecorded;
+    uint64_t rowsDropped;
+    uint64_t batchesRecorded;
+    uint64_t numRejected;
+    std::string lastError;
+
+    /** Take the buffered rows as a batch and record them with the lock
+        released, reacquiring it before returning.
+    */
+    void recordBuffered(std::unique_lock<std::mutex> & guard);
+};
+
+
+/*****************************************************************************/
+/* DATASET ROW STREAMS                                                       */
+/*****************************************************************************/
+
+/** The row streams of all of the datasets of a collection, along with the
+    thread that records the batches that have waited long enough.  The
+    thread is only started once the first stream is created.
+*/
+
+struct DatasetRowStreams {
+    DatasetRowStreams();
+    ~DatasetRowStreams();
+
+    /// Return the stream of the dataset, creating it if needed
+    std::shared_ptr<DatasetRowStream>
+    get(const std::shared_ptr<Dataset> & dataset);
+
+    /// Return the stream of the dataset, or null if it has none
+    std::shared_ptr<DatasetRowStream> find(const Dataset * dataset) const;
+
+private:
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::map<const Dataset *, std::shared_ptr<DatasetRowStream> > streams;
+    std::thread flusher;
+    bool shutdown;
+
+    void runFlusher();
+};
+
+
+/*****************************************************************************/
+/* PARSING                                                                   */
+/*****************************************************************************/
+
+/** Parse newline-delimited JSON, where each non-empty line is a row in the
+    same form as the elements of the body of /multirows:
+    [ row name, [ [ column name, value, timestamp ], ... ] ].
+    Large bodies are parsed in parallel.  Errors mention the line number.
+*/
+std::vector<StreamedRow> parseNdjsonRows(const std::string & payload);
+
+/** Parse a sequence of MessagePack values, each being a row in the same
+    form as above.  Timestamps may be MessagePack timestamps, ISO 8601
+    strings or numbers of seconds since the epoch.
+*/
+std::vector<StreamedRow> parseMsgPackRows(const std::string & payload);
+
+} // namespace MLDB
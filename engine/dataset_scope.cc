@@ -14,6 +14,9 @@
 #include "mldb/types/annotated_exception.h"
 #include "mldb/utils/lightweight_hash.h"
 #include "mldb/sql/sql_utils.h"
+#include "mldb/sql/sql_batch.h"
+#include "mldb/sql/builtin_functions.h"
+#include "mldb/engine/query_result_cache.h"
 
 using namespace std;
 
@@ -46,6 +49,11 @@ doGetFunction(const Utf8String & tableName,
         auto fn = mldb->tryGetFunction(functionName);
 
         if (fn) {
+            // A function can read anything, so we can't tell when a
+            // result that uses it changes
+            if (auto dependencies = QueryDependencyScope::current())
+                dependencies->setUncacheable("calls function " + functionName);
+
             // We found one.  Now wrap it up as a normal function.
             if (args.size() > 1)
                 throw AnnotatedException(400, "User function " + functionName
@@ -82,6 +90,11 @@ doGetFunction(const Utf8String & tableName,
         }
     }
 
+    if (tableName.empty() && Builtins::isNonDeterministicBuiltin(functionName)) {
+        if (auto dependencies = QueryDependencyScope::current())
+            dependencies->setUncacheable("calls " + functionName + "()");
+    }
+
     return SqlBindingScope::doGetFunction(tableName, functionName, args,
                                           argScope);
 }
@@ -90,13 +103,18 @@ std::shared_ptr<Dataset>
 SqlExpressionMldbScope::
 doGetDataset(const Utf8String & datasetName)
 {
-    return mldb->getDataset(datasetName);
+    auto result = mldb->getDataset(datasetName);
+    if (auto dependencies = QueryDependencyScope::current())
+        dependencies->addDataset(result);
+    return result;
 }
 
 std::shared_ptr<Dataset>
 SqlExpressionMldbScope::
 doGetDatasetFromConfig(const Any & datasetConfig)
 {
+    if (auto dependencies = QueryDependencyScope::current())
+        dependencies->setUncacheable("creates a dataset from a config");
     return obtainDataset(mldb, datasetConfig.convert<PolyConfig>());
 }
 
@@ -274,6 +292,7 @@ SqlExpressionDatasetScope(std::shared_ptr<Dataset> dataset, const Utf8String& al
     : SqlExpressionMldbScope(dataset->engine), dataset(*dataset), alias(alias)
 {
      dataset->getChildAliases(childaliases);
+    sharedSubexpressions = std::make_shared<SharedSubexpressions>();
 }
 
 SqlExpressionDatasetScope::
@@ -281,6 +300,7 @@ SqlExpressionDatasetScope(const Dataset & dataset, const Utf8String& alias)
     : SqlExpressionMldbScope(dataset.engine), dataset(dataset), alias(alias)
 {
     dataset.getChildAliases(childaliases);
+    sharedSubexpressions = std::make_shared<SharedSubexpressions>();
 }
 
 SqlExpressionDatasetScope::
@@ -290,6 +310,7 @@ SqlExpressionDatasetScope(const BoundTableExpression& boundDataset)
       alias(boundDataset.asName)
 {
     boundDataset.dataset->getChildAliases(childaliases);
+    sharedSubexpressions = std::make_shared<SharedSubexpressions>();
 }
 
 ColumnGetter
@@ -344,6 +365,29 @@ doGetColumn(const Utf8String & tableName,
             info};
 }
 
+BatchColumnGetter
+SqlExpressionDatasetScope::
+doGetColumnBatch(const Utf8String & tableName,
+                 const ColumnPath & columnName)
+{
+    // Same logic as doGetColumn() to remove the alias
+    ColumnPath simplified;
+    if (tableName.empty() && columnName.size() > 1) {
+        if (!alias.empty() && columnName.startsWith(alias)) {
+            simplified = columnName.removePrefix();
+        }
+    }
+    if (simplified.empty())
+        simplified = columnName;
+
+    return [=] (const SqlBatch & batch,
+                const SqlSelection & selection,
+                SqlBatchVector & out)
+        {
+            return batch.readColumn(simplified, selection, out);
+        };
+}
+
 
 BoundFunction
 SqlExpressionDatasetScope::
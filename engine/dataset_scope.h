@@ -162,6 +162,14 @@ struct SqlExpressionDatasetScope: public SqlExpressionMldbScope {
 
         /// If set, this tells us how to get the value of a bound parameter
         const BoundParameters * params;
+
+        virtual SharedSubexpressionValues * getSharedSubexpressions() const
+        {
+            return &sharedValues;
+        }
+
+        /// Values of the subexpressions shared within the scope for this row
+        mutable SharedSubexpressionValues sharedValues;
     };
 
     SqlExpressionDatasetScope(std::shared_ptr<Dataset> dataset, const Utf8String& alias);
@@ -175,6 +183,14 @@ struct SqlExpressionDatasetScope: public SqlExpressionMldbScope {
     virtual ColumnGetter doGetColumn(const Utf8String & tableName,
                                        const ColumnPath & columnName);
 
+    /** Read the column from the batch.  Datasets that execute expressions
+        in batch mode over their rows provide an SqlBatch whose readColumn()
+        takes the column name without the alias.
+    */
+    virtual BatchColumnGetter
+    doGetColumnBatch(const Utf8String & tableName,
+                     const ColumnPath & columnName);
+
     GetAllColumnsOutput
     doGetAllColumns(const Utf8String & tableName,
                     const ColumnFilter& keep);
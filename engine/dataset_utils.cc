@@ -6,7 +6,11 @@
 */
 
 #include "mldb/engine/dataset_utils.h"
+#include "mldb/sql/sql_expression.h"
 #include "mldb/types/annotated_exception.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/base/parallel.h"
 #include <algorithm>
 
 using namespace std;
@@ -15,6 +19,87 @@ using namespace std;
 namespace MLDB {
 
 
+namespace {
+
+/** Call getList() on each of the children in parallel, and sort the lists
+    that aren't already sorted.
+*/
+template<typename T, typename Children, typename GetList>
+std::vector<std::vector<T> >
+getSortedLists(const Children & children, GetList && getList)
+{
+    std::vector<std::vector<T> > result(children.size());
+
+    auto onChild = [&] (size_t i)
+        {
+            result[i] = getList(*children[i]);
+            if (!std::is_sorted(result[i].begin(), result[i].end()))
+                std::sort(result[i].begin(), result[i].end());
+        };
+
+    parallelMap(0, children.size(), onChild);
+
+    return result;
+}
+
+/** Merge sorted lists into one sorted list without duplicates, of which
+    the first start elements are skipped and at most limit (or all if it's
+    -1) are returned.  The merge stops as soon as the limit is reached.
+*/
+template<typename T>
+std::vector<T>
+mergeSortedLists(std::vector<std::vector<T> > lists,
+                 ssize_t start = 0, ssize_t limit = -1)
+{
+    if (lists.size() == 1) {
+        auto & list = lists[0];
+        list.erase(std::unique(list.begin(), list.end()), list.end());
+        return applyOffsetLimit(start, limit, list);
+    }
+
+    // Heap of (list, position) for the first unmerged element of each
+    // list, with the smallest element on top
+    std::vector<std::pair<size_t, size_t> > heap;
+    for (size_t i = 0;  i < lists.size();  ++i) {
+        if (!lists[i].empty())
+            heap.emplace_back(i, 0);
+    }
+
+    auto greater = [&] (const std::pair<size_t, size_t> & p1,
+                        const std::pair<size_t, size_t> & p2)
+        {
+            return lists[p2.first][p2.second] < lists[p1.first][p1.second];
+        };
+
+    std::make_heap(heap.begin(), heap.end(), greater);
+
+    std::vector<T> result;
+    ssize_t numSkipped = 0;
+    const T * last = nullptr;
+
+    while (!heap.empty() && (limit < 0 || (ssize_t)result.size() < limit)) {
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        auto & top = heap.back();
+        const T & val = lists[top.first][top.second];
+
+        if (!last || *last < val) {
+            if (numSkipped < start)
+                ++numSkipped;
+            else result.push_back(val);
+            last = &val;
+        }
+
+        if (++top.second == lists[top.first].size())
+            heap.pop_back();
+        else std::push_heap(heap.begin(), heap.end(), greater);
+    }
+
+    return result;
+}
+
+} // file scope
+
+
 /******************************************************************************/
 /* MERGED MATRIX VIEW                                                         */
 /******************************************************************************/
@@ -28,51 +113,25 @@ std::vector<RowPath>
 MergedMatrixView::
 getRowPaths(ssize_t start, ssize_t limit) const
 {
-    std::vector<RowPath> names;
-
-    for (const auto& view : views) {
-        auto rows = view->getRowPaths();
-        names.insert(names.end(), rows.begin(), rows.end());
-    }
-
-    std::sort(names.begin(), names.end());
-    names.erase(std::unique(names.begin(), names.end()), names.end());
-
-    if (start > names.size()) return {};
-    if (limit < 0) limit = names.size();
-
-    auto it = names.begin() + start;
-    auto end = start + limit < names.size() ? it + limit : names.end();
-    return std::vector<RowPath>(it, end);
+    auto lists = getSortedLists<RowPath>
+        (views, [] (const MatrixView & view) { return view.getRowPaths(); });
+    return mergeSortedLists(std::move(lists), start, limit);
 }
 
 std::vector<RowHash>
 MergedMatrixView::
 getRowHashes(ssize_t start, ssize_t limit) const
 {
-    std::vector<RowHash> hashes;
-
-    for (const auto& view : views) {
-        auto rows = view->getRowHashes();
-        hashes.insert(hashes.end(), rows.begin(), rows.end());
-    }
-
-    std::sort(hashes.begin(), hashes.end());
-    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
-
-    if (start > hashes.size()) return {};
-    if (limit < 0) limit = hashes.size();
-
-    auto it = hashes.begin() + start;
-    auto end = start + limit <= hashes.size() ? it + limit : hashes.end();
-    return std::vector<RowHash>(it, end);
+    auto lists = getSortedLists<RowHash>
+        (views, [] (const MatrixView & view) { return view.getRowHashes(); });
+    return mergeSortedLists(std::move(lists), start, limit);
 }
 
 size_t
 MergedMatrixView::
 getRowCount() const
 {
-    return getRowPaths().size();
+    return getRowHashes().size();
 }
 
 bool
@@ -93,13 +152,20 @@ getRow(const RowPath & row) const
     MatrixNamedRow result;
     result.rowHash = result.rowName = row;
 
-    for (const auto& view : views) {
-        if (!view->knownRow(row)) continue;
+    std::vector<MatrixNamedRow> rows(views.size());
+
+    auto onView = [&] (size_t i)
+        {
+            if (views[i]->knownRow(row))
+                rows[i] = views[i]->getRow(row);
+        };
 
-        auto rows = view->getRow(row);
+    parallelMap(0, views.size(), onView);
 
-        result.columns.insert(
-                result.columns.end(), rows.columns.begin(), rows.columns.end());
+    for (auto & r: rows) {
+        result.columns.insert(result.columns.end(),
+                              std::make_move_iterator(r.columns.begin()),
+                              std::make_move_iterator(r.columns.end()));
     }
 
     if (result.columns.empty())
@@ -112,17 +178,12 @@ std::vector<ColumnPath>
 MergedMatrixView::
 getColumnPaths(ssize_t offset, ssize_t limit) const
 {
-    std::vector<ColumnPath> result;
-
-    for (const auto& view : views) {
-        auto names = view->getColumnPaths();
-        result.insert(result.end(), names.begin(), names.end());
-    }
-
-    std::sort(result.begin(), result.end());
-    result.erase(std::unique(result.begin(), result.end()), result.end());
-
-    return applyOffsetLimit(offset, limit, result);
+    auto lists = getSortedLists<ColumnPath>
+        (views, [] (const MatrixView & view)
+         {
+             return view.getColumnPaths();
+         });
+    return mergeSortedLists(std::move(lists), offset, limit);
 }
 
 size_t
@@ -149,10 +210,37 @@ knownColumn(const ColumnPath & column) const
 /******************************************************************************/
 
 MergedColumnIndex::
-MergedColumnIndex(std::vector< std::shared_ptr<ColumnIndex> > indexes) :
-    indexes(std::move(indexes))
+MergedColumnIndex(std::vector< std::shared_ptr<ColumnIndex> > indexes,
+                  bool cacheStats) :
+    indexes(std::move(indexes)), cacheStats(cacheStats)
 {}
 
+const ColumnStats &
+MergedColumnIndex::
+getColumnStats(const ColumnPath & column, ColumnStats & stats) const
+{
+    if (cacheStats) {
+        std::unique_lock<std::mutex> guard(statsMutex);
+        auto it = statsCache.find(column);
+        if (it != statsCache.end()) {
+            stats = it->second;
+            return stats;
+        }
+    }
+
+    // A row may be in several of the indexes, so the stats of each can't
+    // simply be added together; instead the values of each are fetched in
+    // parallel and the stats calculated over all of them
+    ColumnIndex::getColumnStats(column, stats);
+
+    if (cacheStats) {
+        std::unique_lock<std::mutex> guard(statsMutex);
+        statsCache.emplace(column, stats);
+    }
+
+    return stats;
+}
+
 MatrixColumn
 MergedColumnIndex::
 getColumn(const ColumnPath & column) const
@@ -160,14 +248,23 @@ getColumn(const ColumnPath & column) const
     MatrixColumn result;
     result.columnHash = column;
 
-    for (const auto& index : indexes) {
-        if (!index->knownColumn(column)) continue;
+    std::vector<MatrixColumn> columns(indexes.size());
 
-        auto ret = index->getColumn(column);
+    auto onIndex = [&] (size_t i)
+        {
+            if (indexes[i]->knownColumn(column))
+                columns[i] = indexes[i]->getColumn(column);
+        };
+
+    parallelMap(0, indexes.size(), onIndex);
+
+    for (auto & ret: columns) {
         if (result.columnName.empty())
             result.columnName = std::move(ret.columnName);
 
-        result.rows.insert(result.rows.end(), ret.rows.begin(), ret.rows.end());
+        result.rows.insert(result.rows.end(),
+                           std::make_move_iterator(ret.rows.begin()),
+                           std::make_move_iterator(ret.rows.end()));
     }
 
     if (result.rows.empty())
@@ -191,17 +288,146 @@ std::vector<ColumnPath>
 MergedColumnIndex::
 getColumnPaths(ssize_t offset, ssize_t limit) const
 {
-    std::vector<ColumnPath> result;
+    auto lists = getSortedLists<ColumnPath>
+        (indexes, [] (const ColumnIndex & index)
+         {
+             return index.getColumnPaths();
+         });
+    return mergeSortedLists(std::move(lists), offset, limit);
+}
 
-    for (const auto& index : indexes) {
-        auto names = index->getColumnPaths();
-        result.insert(result.end(), names.begin(), names.end());
+/******************************************************************************/
+/* CHILD DATASET ROW GENERATION                                               */
+/******************************************************************************/
+
+bool
+readsRowIdentity(const SqlExpression & expr)
+{
+    static const std::vector<Utf8String> identityFunctions = {
+        "rowName", "rowPath", "rowPathElement", "rowHash"
+    };
+
+    UnboundEntities unbound = expr.getUnbound();
+
+    for (auto & fn: identityFunctions) {
+        if (unbound.funcs.count(fn))
+            return true;
+        for (auto & t: unbound.tables) {
+            if (t.second.funcs.count(Path(PathElement(fn))))
+                return true;
+        }
     }
 
-    std::sort(result.begin(), result.end());
-    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return false;
+}
+
+GenerateRowsWhereFunction
+generateChildRowsWhere(const std::vector<std::shared_ptr<Dataset> > & children,
+                       const SqlBindingScope & context,
+                       const Utf8String & alias,
+                       const SqlExpression & where,
+                       bool prefixChildIndex)
+{
+    ExcAssert(!children.empty());
+
+    std::vector<GenerateRowsWhereFunction> generators;
+    generators.reserve(children.size());
+
+    auto complexity = GenerateRowsWhereFunction::CONSTANT;
+    for (auto & c: children) {
+        generators.emplace_back(c->generateRowsWhere(context, alias, where,
+                                                     0 /* offset */,
+                                                     -1 /* limit */));
+        complexity = std::max(complexity, generators.back().complexity);
+    }
 
-    return applyOffsetLimit(offset, limit, result);
+    auto getRow = [=] (size_t child, RowPath row) -> RowPath
+        {
+            if (prefixChildIndex)
+                return PathElement(child) + row;
+            return row;
+        };
+
+    auto exec = [=] (ssize_t numToGenerate, Any token,
+                     const BoundParameters & params,
+                     const ProgressFunc & onProgress)
+        -> std::pair<std::vector<RowPath>, Any>
+        {
+            ExcAssertNotEqual(numToGenerate, 0);
+
+            std::vector<RowPath> result;
+
+            if (numToGenerate == -1 && token.empty()) {
+                // All of the rows; generate the children's in parallel
+                std::vector<std::vector<RowPath> > childRows(generators.size());
+
+                auto doChild = [&] (size_t i)
+                    {
+                        auto rows = generators[i](-1, Any(), params).first;
+                        childRows[i].reserve(rows.size());
+                        for (auto & r: rows)
+                            childRows[i].emplace_back(getRow(i, std::move(r)));
+                    };
+
+                parallelMap(0, generators.size(), doChild);
+
+                size_t total = 0;
+                for (auto & rows: childRows)
+                    total += rows.size();
+                result.reserve(total);
+
+                for (auto & rows: childRows) {
+                    result.insert(result.end(),
+                                  std::make_move_iterator(rows.begin()),
+                                  std::make_move_iterator(rows.end()));
+                }
+
+                return { std::move(result), Any() };
+            }
+
+            // A page of the rows, starting from the offset in the token.
+            // We only ask each child for as many rows as are needed, and
+            // stop at the first child that completes the page.
+            size_t start = token.empty() ? 0 : token.convert<size_t>();
+            size_t toSkip = start;
+
+            auto needed = [&] () -> ssize_t
+                {
+                    if (numToGenerate == -1)
+                        return -1;
+                    return toSkip + numToGenerate - result.size();
+                };
+
+            for (size_t i = 0;  i < generators.size();  ++i) {
+                Any childToken;
+                do {
+                    auto rows = generators[i](needed(), childToken,
+                                              params, onProgress);
+                    childToken = std::move(rows.second);
+
+                    size_t skipped = std::min(toSkip, rows.first.size());
+                    toSkip -= skipped;
+                    for (size_t j = skipped;  j < rows.first.size();  ++j) {
+                        result.emplace_back(getRow(i, std::move(rows.first[j])));
+                    }
+                } while (!childToken.empty() && needed() != 0);
+
+                if (needed() == 0)
+                    break;
+            }
+
+            Any newToken;
+            if (needed() == 0)
+                newToken = start + result.size();
+
+            return { std::move(result), std::move(newToken) };
+        };
+
+    Utf8String explain("concatenate rows generated from "
+                       + std::to_string(children.size()) + " datasets: ");
+    explain += generators[0].explain;
+
+    return { std::move(exec), std::move(explain), complexity };
 }
 
 } // namespace MLDB
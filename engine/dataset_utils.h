@@ -8,6 +8,8 @@
 #pragma once
 
 #include "mldb/core/dataset.h"
+#include <mutex>
+#include <unordered_map>
 
 
 namespace MLDB {
@@ -25,16 +27,44 @@ std::vector<T> applyOffsetLimit(ssize_t offset, ssize_t limit,
     }
     if (limit == -1)
         return std::move(vals);
-    if (limit >= vals.size()) {
-        vals.clear();
-    }
-    else {
+    if (limit < vals.size()) {
         vals.erase(vals.begin() + limit, vals.end());
     }
     return std::move(vals);
 }
 
 
+/******************************************************************************/
+/* CHILD DATASET ROW GENERATION                                               */
+/******************************************************************************/
+
+/** Does the expression use the name or the hash of the row that it's
+    evaluated on, via rowName(), rowPath(), rowPathElement() or rowHash()?
+*/
+bool readsRowIdentity(const SqlExpression & expr);
+
+/** Return a function that generates the rows matching the where
+    expression for a dataset that is made of the given children, by
+    calling generateRowsWhere() on each of them and concatenating their
+    rows in the order of the children.  This lets each child use its own
+    indexes, and the children are run in parallel.
+
+    When prefixChildIndex is true, the rows of child i are returned as
+    i.rowPath, as in a union; otherwise they are returned unchanged,
+    which requires that no row is in more than one child.
+
+    The where expression must give the same result on the row of a child
+    as on the row of the dataset it ends up in, so it can't read the
+    identity of the row if the children's rows are prefixed.
+*/
+GenerateRowsWhereFunction
+generateChildRowsWhere(const std::vector<std::shared_ptr<Dataset> > & children,
+                       const SqlBindingScope & context,
+                       const Utf8String & alias,
+                       const SqlExpression & where,
+                       bool prefixChildIndex);
+
+
 /******************************************************************************/
 /* MERGED MATRIX VIEW                                                         */
 /******************************************************************************/
@@ -43,6 +73,8 @@ std::vector<T> applyOffsetLimit(ssize_t offset, ssize_t limit,
 
     Assumes that the underlying indexes are mutable and will therefore perform a
     full table scan for operations that operates on multiple rows or columns.
+    The views are scanned in parallel, and the sorted lists that they return
+    are merged rather than concatenated and sorted again.
  */
 struct MergedMatrixView : public MatrixView
 {
@@ -74,18 +106,29 @@ private:
 /** Creates a merged "index" of the provided column indexes.
 
     Assumes that the underlying indexes are mutable and will therefore perform a
-    full table scan for operations that operates on multiple columns.
+    full table scan for operations that operates on multiple columns.  The
+    indexes are scanned in parallel.
+
+    If cacheStats is true, the indexes are instead taken not to change, and
+    the merged stats of each column are only calculated once.
  */
 struct MergedColumnIndex : public ColumnIndex
 {
-    MergedColumnIndex(std::vector< std::shared_ptr<ColumnIndex> > indexes);
+    MergedColumnIndex(std::vector< std::shared_ptr<ColumnIndex> > indexes,
+                      bool cacheStats = false);
 
+    const ColumnStats &
+    getColumnStats(const ColumnPath & column, ColumnStats & toStoreResult) const;
     MatrixColumn getColumn(const ColumnPath & column) const;
     bool knownColumn(const ColumnPath & column) const;
     std::vector<ColumnPath> getColumnPaths(ssize_t offset, ssize_t limit) const;
 
 private:
     std::vector< std::shared_ptr<ColumnIndex> > indexes;
+    bool cacheStats;
+
+    mutable std::mutex statsMutex;
+    mutable std::unordered_map<ColumnPath, ColumnStats> statsCache;
 };
 
 } // namespace MLDB
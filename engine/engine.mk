@@ -3,12 +3,17 @@ LIBMLDB_ENGINE_SOURCES:= \
 	analytics.cc \
 	dataset_scope.cc \
 	bound_queries.cc \
+	query_spill.cc \
+	query_result_cache.cc \
 	forwarded_dataset.cc \
 	column_scope.cc \
 	bucket.cc \
 	dataset_collection.cc \
+	dataset_row_stream.cc \
 	procedure_collection.cc \
 	procedure_run_collection.cc \
+	procedure_run_scheduler.cc \
+	procedure_checkpoint.cc \
 	function_collection.cc \
 	credential_collection.cc \
 	type_collection.cc \
@@ -22,6 +27,7 @@ LIBMLDB_ENGINE_LINK:= \
 	sql_expression \
 	credentials \
 	mldb_core \
+	block \
 	command_expression \
 	hoedown \
 
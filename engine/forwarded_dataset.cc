@@ -126,6 +126,15 @@ commit()
     current->commit();
 }
 
+uint64_t
+ForwardedDataset::
+getDataGeneration() const
+{
+    auto current = underlying.load();
+    ExcAssert(current);
+    return current->getDataGeneration();
+}
+
 std::vector<MatrixNamedRow>
 ForwardedDataset::
 queryStructured(const SelectExpression & select,
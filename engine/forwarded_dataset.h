@@ -32,9 +32,9 @@ struct ForwardedDataset: public Dataset {
 
     virtual ~ForwardedDataset();
 
-    /** Set the underlying dataset.  This can only be done once, at
-        initialization time, as there is no locking associated with
-        the pointer for performance reasons.
+    /** Set the underlying dataset.  It may be replaced later; each call
+        that is forwarded reads the pointer once, so it runs entirely on
+        either the old or the new dataset.
     */
     void setUnderlying(std::shared_ptr<Dataset> underlying);
     
@@ -56,6 +56,8 @@ struct ForwardedDataset: public Dataset {
 
     virtual void commit();
 
+    virtual uint64_t getDataGeneration() const;
+
     virtual std::vector<MatrixNamedRow>
     queryStructured(const SelectExpression & select,
                     const WhenExpression & when,
@@ -13,8 +13,12 @@
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/types/meta_value_description.h"
 #include "mldb/engine/dataset_scope.h"
+#include "mldb/base/parallel.h"
 #include "mldb/types/map_description.h"
 #include "mldb/types/vector_description.h"
+#include "mldb/rest/latency_metrics.h"
+#include "mldb/sql/msgpack.h"
+#include <optional>
 
 
 using namespace std;
@@ -54,10 +58,19 @@ registerFunctionType(const Package & package,
 /* FUNCTION                                                                  */
 /*****************************************************************************/
 
+static LatencyMetric functionApplyLatency
+    ("mldb_function_apply_duration_seconds",
+     "Time taken by calls to functions that aren't part of a query, by "
+     "function type and whether they were batched");
+
 ExpressionValue
 Function::
 call(const ExpressionValue & input) const
 {
+    LatencyTimer timer(functionApplyLatency.get
+                       ({ { "type", getMetricsType() },
+                          { "batch", "false" } }));
+
     SqlExpressionMldbScope outerContext(MldbEntity::getOwner(this->engine));
     
     auto info = this->getFunctionInfo();
@@ -119,6 +132,69 @@ call(const ExpressionValue & input) const
 /* FUNCTION COLLECTION                                                       */
 /*****************************************************************************/
 
+namespace {
+
+/// Keep only the given values of a function's output, if any are given
+ExpressionValue
+keepOnly(ExpressionValue output, const std::vector<Utf8String> & keepValues)
+{
+    if (keepValues.empty())
+        return output;
+
+    StructValue outputStruct;
+    outputStruct.reserve(keepValues.size());
+    for (auto & p: keepValues) {
+        outputStruct.emplace_back(p, output.getColumn(p));
+    }
+    return std::move(outputStruct);
+}
+
+/// Body of a MessagePack call to a function
+struct MsgPackCall {
+    /// Reader positioned at the "input" value
+    std::optional<MsgPackReader> input;
+    std::vector<Utf8String> keepValues;
+};
+
+MsgPackCall readMsgPackCall(const std::string & payload)
+{
+    MsgPackCall result;
+    MsgPackReader reader(payload);
+
+    size_t n = reader.readMap();
+    for (size_t i = 0;  i < n;  ++i) {
+        std::string_view key = reader.readString();
+        if (key == "input") {
+            result.input = reader;
+            reader.skip();
+        }
+        else if (key == "keepValues") {
+            size_t numValues = reader.readArray();
+            for (size_t j = 0;  j < numValues;  ++j) {
+                std::string_view value = reader.readString();
+                result.keepValues.emplace_back(value.data(), value.size());
+            }
+        }
+        else {
+            throw AnnotatedException
+                (400, "Unknown key in MessagePack function call; accepted "
+                 "keys are 'input' and 'keepValues'",
+                 "key", std::string(key));
+        }
+    }
+
+    if (!reader.eof())
+        throw AnnotatedException(400, "Extra data after MessagePack "
+                                 "function call");
+    if (!result.input)
+        throw AnnotatedException(400, "MessagePack function call has no "
+                                 "'input'");
+
+    return result;
+}
+
+} // file scope
+
 FunctionCollection::
 FunctionCollection(MldbEngine * engine)
     : PolyCollection<Function>("function", "functions", engine->getDirectory()),
@@ -140,23 +216,13 @@ applyFunction(const Function * function,
         inputExpr.emplace_back(i.first, i.second);
     }
 
+    // Function calls over REST are latency sensitive
+    ParallelismScope parallelism;
     ExpressionValue output = function->call(std::move(inputExpr));
 
     //cerr << "output = " << jsonEncode(output) << endl;
 
-    ExpressionValue result;
-
-    if (!keepValues.empty()) {
-        StructValue outputStruct;
-        outputStruct.reserve(keepValues.size());
-        for (auto & p: keepValues) {
-            outputStruct.emplace_back(p, output.getColumn(p));
-        }
-        result = std::move(outputStruct);
-    }
-    else {
-        result = std::move(output);
-    }
+    ExpressionValue result = keepOnly(std::move(output), keepValues);
 
     if (outputFormat == "compat") {
         static auto valDesc = getExpressionValueDescriptionNoTimestamp();
@@ -222,47 +288,166 @@ applyBatch(const Function * function,
     auto info = function->getFunctionInfo();
     auto applier = function->bind(outerContext, info.input);
     
+    ParallelismScope parallelism;
     Date ts = Date::now();
 
-    auto doInput = [&] (const Json::Value & val)
+    auto parseInput = [&] (const Json::Value & val)
         {
             StructuredJsonParsingContext context(val);
-            ExpressionValue inputExpr
-                = ExpressionValue::parseJson(context, ts);
-            ExpressionValue output
-                = function->apply(*applier, std::move(inputExpr));
-            output.extractJson(printingContext);
+            return ExpressionValue::parseJson(context, ts);
         };
 
     if (inputs.isNull()) {
         connection.sendResponse(200, inputs, "application/json");
         return;
     }
-    else if (inputs.isArray()) {
-        printingContext.startArray(inputs.size());
+
+    // Apply the function to all of the inputs at once, so that it can
+    // share its work over the batch
+    std::vector<ExpressionValue> inputExprs;
+    if (inputs.isArray() || inputs.isObject()) {
+        inputExprs.reserve(inputs.size());
         for (auto it = inputs.begin(), end = inputs.end();
              it != end;  ++it) {
+            inputExprs.emplace_back(parseInput(*it));
+        }
+    }
+    else {
+        inputExprs.emplace_back(parseInput(inputs));
+    }
+
+    std::vector<ExpressionValue> outputs;
+    {
+        LatencyTimer timer(functionApplyLatency.get
+                           ({ { "type", function->getMetricsType() },
+                              { "batch", "true" } }));
+        outputs = applier->applyBatch(inputExprs);
+    }
+    ExcAssertEqual(outputs.size(), inputExprs.size());
+
+    if (inputs.isArray()) {
+        printingContext.startArray(inputs.size());
+        for (auto & output: outputs) {
             printingContext.newArrayElement();
-            doInput(*it);
+            output.extractJson(printingContext);
         }
         printingContext.endArray();
     }
     else if (inputs.isObject()) {
         printingContext.startObject();
+        size_t i = 0;
         for (auto it = inputs.begin(), end = inputs.end();
-             it != end;  ++it) {
+             it != end;  ++it, ++i) {
             printingContext.startMember(it.memberName());
-            doInput(*it);
+            outputs[i].extractJson(printingContext);
         }
         printingContext.endObject();
     }
     else {
-        doInput(inputs);
+        outputs[0].extractJson(printingContext);
     }
 
     connection.sendResponse(200, str.stealRawString(), "application/json");
 }
 
+void
+FunctionCollection::
+applyFunctionMsgPack(const Function * function,
+                     const std::string & payload,
+                     RestConnection & connection) const
+{
+    MsgPackCall call = readMsgPackCall(payload);
+
+    // Like JSON input, the values have no timestamp
+    ExpressionValue input = call.input->readValue(Date::notADate());
+    if (!input.isRow() && !input.empty())
+        throw AnnotatedException(400, "MessagePack function call 'input' "
+                                 "must be a map");
+
+    // Function calls over REST are latency sensitive
+    ParallelismScope parallelism;
+    ExpressionValue output = function->call(std::move(input));
+
+    MsgPackWriter writer;
+    writer.write(keepOnly(std::move(output), call.keepValues));
+    connection.sendResponse(200, std::move(writer.bytes),
+                            MSGPACK_CONTENT_TYPE);
+}
+
+void
+FunctionCollection::
+applyBatchMsgPack(const Function * function,
+                  const std::string & payload,
+                  RestConnection & connection) const
+{
+    MsgPackCall call = readMsgPackCall(payload);
+    MsgPackReader & reader = *call.input;
+
+    SqlExpressionMldbScope outerContext(MldbEntity::getOwner(this->engine));
+    
+    auto info = function->getFunctionInfo();
+    auto applier = function->bind(outerContext, info.input);
+    
+    ParallelismScope parallelism;
+    Date ts = Date::now();
+
+    MsgPackWriter writer;
+
+    if (reader.peek() == MsgPackReader::NIL) {
+        writer.writeNil();
+        connection.sendResponse(200, std::move(writer.bytes),
+                                MSGPACK_CONTENT_TYPE);
+        return;
+    }
+
+    // Keys of the rows when the input is a map; they point into the payload
+    std::vector<std::string_view> keys;
+    std::vector<ExpressionValue> inputExprs;
+
+    auto kind = reader.peek();
+    if (kind == MsgPackReader::ARRAY) {
+        size_t n = reader.readArray();
+        inputExprs.reserve(n);
+        for (size_t i = 0;  i < n;  ++i)
+            inputExprs.emplace_back(reader.readValue(ts));
+    }
+    else if (kind == MsgPackReader::MAP) {
+        size_t n = reader.readMap();
+        keys.reserve(n);
+        inputExprs.reserve(n);
+        for (size_t i = 0;  i < n;  ++i) {
+            keys.emplace_back(reader.readString());
+            inputExprs.emplace_back(reader.readValue(ts));
+        }
+    }
+    else {
+        inputExprs.emplace_back(reader.readValue(ts));
+    }
+
+    std::vector<ExpressionValue> outputs;
+    {
+        LatencyTimer timer(functionApplyLatency.get
+                           ({ { "type", function->getMetricsType() },
+                              { "batch", "true" } }));
+        outputs = applier->applyBatch(inputExprs);
+    }
+    ExcAssertEqual(outputs.size(), inputExprs.size());
+
+    if (kind == MsgPackReader::ARRAY)
+        writer.startArray(outputs.size());
+    else if (kind == MsgPackReader::MAP)
+        writer.startMap(outputs.size());
+
+    for (size_t i = 0;  i < outputs.size();  ++i) {
+        if (kind == MsgPackReader::MAP)
+            writer.writeString(keys[i]);
+        writer.write(keepOnly(std::move(outputs[i]), call.keepValues));
+    }
+
+    connection.sendResponse(200, std::move(writer.bytes),
+                            MSGPACK_CONTENT_TYPE);
+}
+
 void
 FunctionCollection::
 initRoutes(RouteManager & manager)
@@ -290,6 +475,58 @@ initRoutes(RouteManager & manager)
         "'json' is JSON output; 'compat' (default) is structured output "
         "compatible with old versions of MLDB.";
 
+    // MessagePack calls are selected on the Content-Type of the body, and
+    // so must be added before the JSON routes for the same paths
+    typedef void (FunctionCollection::* MsgPackMethod)
+        (const Function *, const std::string &, RestConnection &) const;
+
+    auto addMsgPackRoute = [&] (const std::string & path,
+                                MsgPackMethod method,
+                                const Utf8String & description)
+        {
+            auto getCollection = manager.getCollection;
+            RestRequestRouter::OnProcessRequest handler
+                = [=] (RestConnection & connection,
+                       const RestRequest & req,
+                       RestRequestParsingContext & cxt)
+                {
+                    try {
+                        auto collection = static_cast<FunctionCollection *>
+                            (getCollection(cxt));
+                        (collection->*method)(getFunction(cxt), req.payload,
+                                              connection);
+                        return RestRequestRouter::MR_YES;
+                    }
+                    catch (const AnnotatedException & exc) {
+                        return sendExceptionResponse(connection, exc);
+                    } catch (const std::exception & exc) {
+                        return sendExceptionResponse(connection, exc);
+                    } MLDB_CATCH_ALL {
+                        connection.sendErrorResponse
+                            (400, "Unknown exception was thrown");
+                        return RestRequestRouter::MR_ERROR;
+                    }
+                };
+
+            // application/x-msgpack is what most clients sent before the
+            // type was registered
+            for (const char * contentType:
+                     { "application/msgpack", "application/x-msgpack" }) {
+                std::string filter = "header:content-type=";
+                filter += contentType;
+                manager.valueNode->addRoute(path, { "GET", "POST", filter },
+                                            description, handler,
+                                            Json::Value());
+            }
+        };
+
+    addMsgPackRoute("/application", &FunctionCollection::applyFunctionMsgPack,
+                    "Apply a function to a MessagePack map of input values "
+                    "and return the output as MessagePack");
+    addMsgPackRoute("/batch", &FunctionCollection::applyBatchMsgPack,
+                    "Apply a function to each of a MessagePack array or map "
+                    "of inputs and return the outputs as MessagePack");
+
     addRouteAsync(*manager.valueNode, "/application", { "GET" },
                   "Apply a function to a given set of input values and return the output",
                   //"Output of all values or those selected in the keepValues parameter",
@@ -344,6 +581,13 @@ initRoutes(RouteManager & manager)
                            &Function::getDetails,
                            getFunction);
 
+    addRouteSyncJsonReturn(*manager.valueNode, "/cache", { "GET" },
+                           "Return statistics about the function's cache of "
+                           "outputs",
+                           "Cache size, capacity, hits, misses and hit rate",
+                           &Function::getCacheStats,
+                           getFunction);
+
     // Make the plugin handle a route
     RestRequestRouter::OnProcessRequest handlePluginRoute
         = [=] (RestConnection & connection,
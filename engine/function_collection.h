@@ -42,6 +42,22 @@ struct FunctionCollection: public PolyCollection<Function> {
                     const std::string & outputFormat,
                     RestConnection & connection) const;
     
+    /** Apply the function to a MessagePack request body, which is a map
+        with an "input" map and an optional "keepValues" array of strings,
+        and send the output back as MessagePack.
+    */
+    void applyFunctionMsgPack(const Function * function,
+                              const std::string & payload,
+                              RestConnection & connection) const;
+
+    /** Apply the function to each of the rows in the "input" array or map
+        of a MessagePack request body, and send back the outputs as
+        MessagePack in an array or map of the same shape.
+    */
+    void applyBatchMsgPack(const Function * function,
+                           const std::string & payload,
+                           RestConnection & connection) const;
+
     static ExpressionValue call(MldbEngine * engine,
                                const Function * function,
                                const std::map<Utf8String, ExpressionValue> & input,
@@ -0,0 +1,184 @@
+/** procedure_checkpoint.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Checkpoints of the progress of a procedure run.
+*/
+
+#include "procedure_checkpoint.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include <algorithm>
+#include <map>
+#include <sstream>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PROCEDURE CHECKPOINT                                                      */
+/*****************************************************************************/
+
+namespace {
+
+/// Read a checkpoint file, throwing if it's incomplete
+Json::Value readManifest(const std::string & uri)
+{
+    filter_istream stream(uri);
+    std::ostringstream contents;
+    contents << stream.rdbuf();
+    Json::Value result = Json::parse(contents.str());
+    if (!result.isObject() || !result.isMember("progress"))
+        throw MLDB::Exception("checkpoint " + uri + " is incomplete");
+    return result;
+}
+
+} // file scope
+
+ProcedureCheckpoint::
+ProcedureCheckpoint(const ProcedureRunConfig & run)
+    : intervalSeconds(run.checkpoint.intervalSeconds),
+      sequence(0), lastSaved(Date::now()), numSaved_(0)
+{
+    if (run.checkpoint.url.empty())
+        return;
+
+    dir = Url(run.checkpoint.url).toDecodedString();
+    if (dir.back() != '/')
+        dir += '/';
+    makeUriDirectory(dir);
+
+    std::map<int64_t, std::string> manifests;
+    auto onObject = [&] (const std::string & uri,
+                         const FsObjectInfo & info,
+                         const OpenUriObject & open,
+                         int depth)
+        {
+            long long n;
+            int len = 0;
+            std::string name = baseName(uri);
+            if (sscanf(name.c_str(), "checkpoint-%lld.json%n", &n, &len) == 1
+                && len == name.size())
+                manifests[n] = uri;
+            return true;
+        };
+
+    forEachUriObject(dir, onObject);
+
+    // Resume from the latest checkpoint that can be read; the run may have
+    // died while writing the one after it
+    int64_t resumedFrom = -1;
+    if (run.checkpoint.resume) {
+        for (auto it = manifests.rbegin();  it != manifests.rend();  ++it) {
+            try {
+                Json::Value manifest = readManifest(it->second);
+                resumedProgress = manifest["progress"];
+                for (auto & f: manifest["files"])
+                    files.push_back(f.asString());
+                resumedFrom = it->first;
+                break;
+            } catch (const std::exception & exc) {
+                cerr << "ignoring checkpoint " << it->second << ": "
+                     << exc.what() << endl;
+            }
+        }
+    }
+
+    // Everything else belongs to an earlier run (or is what we couldn't
+    // read), and would be confused with what this run saves
+    for (auto & m: manifests) {
+        if (m.first == resumedFrom)
+            continue;
+        try {
+            for (auto & f: readManifest(m.second)["files"]) {
+                std::string file = f.asString();
+                if (std::find(files.begin(), files.end(), file) == files.end())
+                    tryEraseUriObject(file);
+            }
+        } catch (const std::exception & exc) {
+        }
+        tryEraseUriObject(m.second);
+    }
+
+    if (resumedFrom != -1)
+        sequence = resumedFrom;
+}
+
+bool
+ProcedureCheckpoint::
+due() const
+{
+    return enabled()
+        && Date::now().secondsSince(lastSaved) >= intervalSeconds;
+}
+
+std::string
+ProcedureCheckpoint::
+manifestUri(int64_t sequence) const
+{
+    return dir + "checkpoint-" + std::to_string(sequence) + ".json";
+}
+
+Url
+ProcedureCheckpoint::
+fileUrl(const std::string & name)
+{
+    ExcAssert(enabled());
+    std::string uri = dir + name;
+    if (std::find(files.begin(), files.end(), uri) == files.end())
+        files.push_back(uri);
+    return Url(uri);
+}
+
+void
+ProcedureCheckpoint::
+save(const Json::Value & progress)
+{
+    ExcAssert(enabled());
+
+    Json::Value manifest;
+    manifest["sequence"] = sequence + 1;
+    manifest["saved"] = Date::now().printIso8601();
+    manifest["progress"] = progress;
+    manifest["files"] = Json::Value(Json::arrayValue);
+    for (auto & f: files)
+        manifest["files"].append(f);
+
+    {
+        filter_ostream stream(manifestUri(sequence + 1));
+        stream << manifest.toStyledString();
+        stream.close();
+    }
+
+    // Only once the new one is complete can the old one go
+    if (sequence > 0)
+        tryEraseUriObject(manifestUri(sequence));
+
+    ++sequence;
+    ++numSaved_;
+    lastSaved = Date::now();
+}
+
+void
+ProcedureCheckpoint::
+finish()
+{
+    if (!enabled())
+        return;
+
+    // The checkpoint goes first, so that a failure part way through
+    // doesn't leave one that refers to missing files
+    if (sequence > 0)
+        tryEraseUriObject(manifestUri(sequence));
+    for (auto & f: files)
+        tryEraseUriObject(f);
+    files.clear();
+    sequence = 0;
+}
+
+} // namespace MLDB
@@ -0,0 +1,91 @@
+/** procedure_checkpoint.h                                          -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Checkpoints of the progress of a procedure run.
+*/
+
+#pragma once
+
+#include "mldb/core/procedure.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include "mldb/types/date.h"
+#include "mldb/types/url.h"
+#include <string>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PROCEDURE CHECKPOINT                                                      */
+/*****************************************************************************/
+
+/** Saves the progress of a procedure run into the directory given by the
+    checkpoint field of its ProcedureRunConfig, and gives it back to a run
+    that resumes.
+
+    The progress is a JSON document that only the procedure understands,
+    which may refer to files that the procedure writes into the directory
+    (named by fileUrl()) before calling save().  Each save() writes a new
+    checkpoint-<n>.json file and then removes the older one, so there is
+    always a complete checkpoint to resume from, even if the run dies while
+    saving.
+*/
+
+struct ProcedureCheckpoint {
+
+    /** Prepare for the given run.  If it resumes, the most recent
+        checkpoint is read; if not, any checkpoints already in the
+        directory are removed along with their files.
+    */
+    ProcedureCheckpoint(const ProcedureRunConfig & run);
+
+    /// Does the run save checkpoints?
+    bool enabled() const { return !dir.empty(); }
+
+    /** Progress saved by the checkpoint that the run resumes from, or null
+        if it doesn't resume or there was no checkpoint.
+    */
+    const Json::Value & resumed() const { return resumedProgress; }
+
+    /// Number of seconds between checkpoints
+    double interval() const { return intervalSeconds; }
+
+    /** Has the checkpoint interval passed since the last checkpoint was
+        saved (or since the run started)?
+    */
+    bool due() const;
+
+    /** URL of a file with the given name in the checkpoint directory.  It
+        belongs to the checkpoints from the next one saved onwards, and is
+        removed with them.
+    */
+    Url fileUrl(const std::string & name);
+
+    /** Save a checkpoint with the given progress.  The files it refers to
+        must already be written.
+    */
+    void save(const Json::Value & progress);
+
+    /** The run has finished, so its checkpoints are no longer needed and
+        are removed along with their files.
+    */
+    void finish();
+
+    /// Number of checkpoints saved by this run
+    int numSaved() const { return numSaved_; }
+
+private:
+    std::string dir;           ///< With a trailing slash; empty if disabled
+    double intervalSeconds;
+    Json::Value resumedProgress;
+    std::vector<std::string> files;  ///< Files of the checkpoints
+    int64_t sequence;          ///< Number of the last checkpoint
+    Date lastSaved;
+    int numSaved_;
+
+    std::string manifestUri(int64_t sequence) const;
+};
+
+} // namespace MLDB
@@ -13,6 +13,7 @@
 #include "mldb/utils/json_utils.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/engine/procedure_collection.h"
+#include "mldb/engine/procedure_run_scheduler.h"
 
 
 using namespace std;
@@ -26,12 +27,14 @@ namespace MLDB {
 /*****************************************************************************/
 
 ProcedureRunCollection::
-ProcedureRunCollection(RestDirectory * server, Procedure * procedure)
+ProcedureRunCollection(RestDirectory * server, Procedure * procedure,
+                       ProcedureRunScheduler * scheduler)
     : RestConfigurableCollection<Utf8String, ProcedureRun,
                                  ProcedureRunConfig, ProcedureRunStatus>
       ("run", "runs", procedure),
       server(server),
-      procedure(procedure)
+      procedure(procedure),
+      scheduler(scheduler)
 {
 }
 
@@ -231,6 +234,8 @@ getStatusLoading(Utf8String key, const BackgroundTask & task) const
     result.id = key;
     result.state = task.getState();
     result.progress = task.getProgress();
+    if (scheduler && scheduler->isQueued(procedure->getName(), key))
+        result.state = "queued";
     return result;
 }
 
@@ -252,6 +257,8 @@ getStatusFinished(Utf8String key, const ProcedureRun & value) const
     result.status = value.results;
     result.runStarted = value.runStarted;
     result.runFinished = value.runFinished;
+    result.memory = value.memory;
+    result.resources = value.resources;
     return result;
 }
 
@@ -259,6 +266,11 @@ std::shared_ptr<ProcedureRun>
 ProcedureRunCollection::
 construct(ProcedureRunConfig config, const OnProgress & onProgress) const
 {
+    // Held until the run is over, to keep its reservation
+    std::shared_ptr<void> ticket;
+    if (scheduler)
+        ticket = scheduler->admit(procedure->getName(), config.id, config,
+                                  onProgress);
     return std::make_shared<ProcedureRun>(procedure, config, onProgress);
 }
 
@@ -15,6 +15,8 @@
 
 namespace MLDB {
 
+struct ProcedureRunScheduler;
+
 /*****************************************************************************/
 /* PROCEDURE TRAINING COLLECTION                                             */
 /*****************************************************************************/
@@ -25,10 +27,15 @@ struct ProcedureRunCollection
                                         ProcedureRunConfig,
                                         ProcedureRunStatus> {
 
-    ProcedureRunCollection(RestDirectory * server, Procedure * owner);
+    /** If a scheduler is given, runs wait in its queue until it lets
+        them start.
+    */
+    ProcedureRunCollection(RestDirectory * server, Procedure * owner,
+                           ProcedureRunScheduler * scheduler = nullptr);
     
     RestDirectory * server;
     Procedure * procedure;
+    ProcedureRunScheduler * scheduler;
         
     static void initRoutes(RouteManager & manager);
 
@@ -0,0 +1,332 @@
+/** procedure_run_scheduler.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Scheduler that decides when procedure runs may start.
+*/
+
+#include "procedure_run_scheduler.h"
+#include "mldb/core/procedure.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/rest/cancellation_exception.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
+#include <chrono>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PROCEDURE RUN LIMITS                                                      */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(ProcedureRunLimits);
+
+ProcedureRunLimitsDescription::
+ProcedureRunLimitsDescription()
+{
+    addField("maxConcurrentRuns", &ProcedureRunLimits::maxConcurrentRuns,
+             "Number of procedure runs that may execute at the same time.  "
+             "The default of -1 means no limit.", -1);
+    addField("cpus", &ProcedureRunLimits::cpus,
+             "Number of CPUs that may be reserved by the runs that execute "
+             "at the same time.  The default of -1 means the number of "
+             "CPUs of the machine.", -1.0);
+    addField("memoryBytes", &ProcedureRunLimits::memoryBytes,
+             "Bytes of memory that may be reserved by the runs that execute "
+             "at the same time.  The default of 0 means no limit.",
+             (uint64_t)0);
+}
+
+
+/*****************************************************************************/
+/* PROCEDURE RUN SCHEDULER                                                   */
+/*****************************************************************************/
+
+namespace {
+
+/// Set while the thread is executing a run that was admitted
+static __thread int scheduledRunDepth = 0;
+
+} // file scope
+
+struct ProcedureRunScheduler::Entry {
+    Utf8String procedure;
+    Utf8String runId;
+    double cpus = 0;
+    uint64_t memoryBytes = 0;
+    int priority = 0;
+    uint64_t sequence = 0;
+    Date submitted;
+    Date started;
+
+    Json::Value toJson() const
+    {
+        Json::Value result;
+        result["procedure"] = procedure;
+        result["run"] = runId;
+        result["cpus"] = cpus;
+        result["memoryBytes"] = memoryBytes;
+        result["queuePriority"] = priority;
+        result["submitted"] = submitted.printIso8601();
+        if (started != Date())
+            result["started"] = started.printIso8601();
+        return result;
+    }
+};
+
+ProcedureRunScheduler::
+ProcedureRunScheduler()
+    : cpuCapacity(numCpus()), nextSequence(0),
+      cpusReserved(0), memoryReserved(0),
+      numStarted(0), numQueued(0), totalWaitSeconds(0)
+{
+}
+
+ProcedureRunScheduler::
+~ProcedureRunScheduler()
+{
+}
+
+void
+ProcedureRunScheduler::
+setLimits(const ProcedureRunLimits & newLimits)
+{
+    if (newLimits.maxConcurrentRuns != -1 && newLimits.maxConcurrentRuns < 1)
+        throw AnnotatedException(400, "maxConcurrentRuns must be -1 or at "
+                                 "least 1",
+                                 "maxConcurrentRuns",
+                                 newLimits.maxConcurrentRuns);
+    if (newLimits.cpus != -1 && newLimits.cpus <= 0)
+        throw AnnotatedException(400, "cpus must be -1 or positive",
+                                 "cpus", newLimits.cpus);
+
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        limits = newLimits;
+        cpuCapacity = limits.cpus == -1 ? numCpus() : limits.cpus;
+    }
+    changed.notify_all();
+}
+
+ProcedureRunLimits
+ProcedureRunScheduler::
+getLimits() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    return limits;
+}
+
+void
+ProcedureRunScheduler::
+parseLimits(const std::string & spec)
+{
+    ProcedureRunLimits result;
+    const char * p = spec.c_str();
+    char * e = nullptr;
+
+    result.maxConcurrentRuns = strtol(p, &e, 10);
+    bool ok = e != p;
+    if (ok && *e == ':') {
+        p = e + 1;
+        result.cpus = strtod(p, &e);
+        ok = e != p;
+    }
+    if (ok && *e == ':') {
+        p = e + 1;
+        double memory = strtod(p, &e);
+        ok = e != p;
+        switch (ok ? *e : 0) {
+        case 'T': memory *= 1024;  // fall through
+        case 'G': memory *= 1024;  // fall through
+        case 'M': memory *= 1024;  // fall through
+        case 'K': memory *= 1024;  ++e;  break;
+        default: break;
+        }
+        result.memoryBytes = memory;
+    }
+    if (!ok || *e != 0)
+        throw AnnotatedException(400, "procedure run limits must look like "
+                                 "maxConcurrentRuns[:cpus[:memoryBytes]]",
+                                 "limits", spec);
+
+    setLimits(result);
+}
+
+bool
+ProcedureRunScheduler::
+canStart(const Entry & entry) const
+{
+    if (queued.empty() || queued.front().get() != &entry)
+        return false;
+
+    // Something that doesn't fit at all gets the whole machine
+    if (running.empty())
+        return true;
+
+    if (limits.maxConcurrentRuns != -1
+        && running.size() >= limits.maxConcurrentRuns)
+        return false;
+    if (cpusReserved + entry.cpus > cpuCapacity)
+        return false;
+    if (limits.memoryBytes != 0
+        && memoryReserved + entry.memoryBytes > limits.memoryBytes)
+        return false;
+    return true;
+}
+
+std::shared_ptr<void>
+ProcedureRunScheduler::
+admit(const Utf8String & procedure,
+      const Utf8String & runId,
+      const ProcedureRunConfig & config,
+      const OnWaiting & onWaiting)
+{
+    auto entry = std::make_shared<Entry>();
+    entry->procedure = procedure;
+    entry->runId = runId;
+    entry->cpus = config.resources.cpus;
+    entry->memoryBytes = config.resources.memoryBytes;
+    entry->priority = config.queuePriority;
+    entry->submitted = Date::now();
+
+    auto makeTicket = [&] (bool reserved)
+        {
+            ++scheduledRunDepth;
+            return std::shared_ptr<void>
+                (entry.get(),
+                 [this, entry, reserved] (void *)
+                 {
+                     --scheduledRunDepth;
+                     if (reserved)
+                         release(entry);
+                 });
+        };
+
+    // Nested runs don't wait for their parent
+    if (scheduledRunDepth > 0)
+        return makeTicket(false);
+
+    std::unique_lock<std::mutex> guard(mutex);
+
+    entry->sequence = nextSequence++;
+
+    // Insert after everything of the same or a higher priority
+    auto it = queued.begin();
+    while (it != queued.end() && (*it)->priority >= entry->priority)
+        ++it;
+    queued.insert(it, entry);
+
+    bool waited = false;
+    while (!canStart(*entry)) {
+        waited = true;
+        if (onWaiting) {
+            size_t position = 0;
+            for (auto & q: queued) {
+                if (q == entry)
+                    break;
+                ++position;
+            }
+
+            Json::Value progress;
+            progress["queued"] = true;
+            progress["queuePosition"] = position;
+            progress["runsExecuting"] = running.size();
+
+            // Don't call out with the lock held
+            guard.unlock();
+            bool keepGoing = onWaiting(progress);
+            guard.lock();
+
+            if (!keepGoing) {
+                queued.remove(entry);
+                guard.unlock();
+                changed.notify_all();
+                throw CancellationException("procedure run was cancelled "
+                                            "while queued");
+            }
+        }
+
+        if (canStart(*entry))
+            break;
+        changed.wait_for(guard, std::chrono::milliseconds(500));
+    }
+
+    queued.pop_front();
+    running.push_back(entry);
+    cpusReserved += entry->cpus;
+    memoryReserved += entry->memoryBytes;
+    entry->started = Date::now();
+    ++numStarted;
+    if (waited) {
+        ++numQueued;
+        totalWaitSeconds += entry->started.secondsSince(entry->submitted);
+    }
+    guard.unlock();
+
+    // The next one in the queue may fit too
+    changed.notify_all();
+
+    return makeTicket(true);
+}
+
+void
+ProcedureRunScheduler::
+release(const std::shared_ptr<Entry> & entry)
+{
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        running.remove(entry);
+        cpusReserved -= entry->cpus;
+        memoryReserved -= entry->memoryBytes;
+        if (running.empty())
+            cpusReserved = 0;  // no accumulated rounding errors
+    }
+    changed.notify_all();
+}
+
+bool
+ProcedureRunScheduler::
+isQueued(const Utf8String & procedure, const Utf8String & runId) const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    for (auto & q: queued) {
+        if (q->runId == runId && q->procedure == procedure)
+            return true;
+    }
+    return false;
+}
+
+Json::Value
+ProcedureRunScheduler::
+getStatus() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    Json::Value result;
+    result["limits"] = jsonEncode(limits);
+    result["cpusReserved"] = cpusReserved;
+    result["cpusAvailable"] = cpuCapacity;
+    result["memoryReserved"] = memoryReserved;
+    result["numExecuting"] = running.size();
+    result["numQueued"] = queued.size();
+    result["numStarted"] = numStarted;
+    result["numStartedAfterWaiting"] = numQueued;
+    result["meanWaitSeconds"]
+        = numQueued ? totalWaitSeconds / numQueued : 0.0;
+
+    result["executing"] = Json::Value(Json::arrayValue);
+    for (auto & r: running)
+        result["executing"].append(r->toJson());
+    result["queued"] = Json::Value(Json::arrayValue);
+    for (auto & q: queued)
+        result["queued"].append(q->toJson());
+    return result;
+}
+
+} // namespace MLDB
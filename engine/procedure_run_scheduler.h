@@ -0,0 +1,136 @@
+/** procedure_run_scheduler.h                                      -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Scheduler that decides when procedure runs may start.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include "mldb/ext/jsoncpp/json.h"
+#include "mldb/types/date.h"
+#include "mldb/types/string.h"
+#include "mldb/types/value_description_fwd.h"
+
+
+namespace MLDB {
+
+struct ProcedureRunConfig;
+
+
+/*****************************************************************************/
+/* PROCEDURE RUN LIMITS                                                      */
+/*****************************************************************************/
+
+/** Capacity that procedure runs share. */
+
+struct ProcedureRunLimits {
+    /// Number of runs that may execute at the same time, or -1 for no limit
+    int maxConcurrentRuns = -1;
+
+    /// CPUs that may be reserved by the runs that execute at the same
+    /// time, or -1 for the number of CPUs of the machine
+    double cpus = -1;
+
+    /// Bytes of memory that may be reserved by the runs that execute at
+    /// the same time, or 0 for no limit
+    uint64_t memoryBytes = 0;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(ProcedureRunLimits);
+
+
+/*****************************************************************************/
+/* PROCEDURE RUN SCHEDULER                                                   */
+/*****************************************************************************/
+
+/** Queue of procedure runs waiting for capacity.  Every run reserves the
+    CPUs and memory declared in the resources of its ProcedureRunConfig,
+    and may only start once the runs already executing leave enough of
+    the limits above for it, and there are fewer of them than
+    maxConcurrentRuns.
+
+    Waiting runs are started by decreasing queuePriority, then in the
+    order they were submitted.  Only the run at the head of the queue may
+    start, so that a large run isn't starved by a stream of small ones.
+    A run that reserves more than the limits allow starts on its own once
+    nothing else is executing.
+
+    Runs that are submitted from a thread that is executing a scheduled
+    run (a procedure that runs another one) are started straight away;
+    making them wait for the run that is waiting for them would deadlock.
+*/
+
+struct ProcedureRunScheduler {
+    ProcedureRunScheduler();
+    ~ProcedureRunScheduler();
+
+    /** Replace the limits.  Runs that are waiting are reconsidered
+        straight away. */
+    void setLimits(const ProcedureRunLimits & limits);
+
+    ProcedureRunLimits getLimits() const;
+
+    /** Set the limits from a string like "4:16:64G", which is
+        maxConcurrentRuns[:cpus[:memoryBytes]], where the memory may have a
+        K, M, G or T suffix.
+    */
+    void parseLimits(const std::string & spec);
+
+    /** Function called while a run waits.  It's passed a description of
+        the run's place in the queue, and returns false if the run was
+        cancelled.
+    */
+    typedef std::function<bool (const Json::Value & progress)> OnWaiting;
+
+    /** Wait until the run may execute, and return a ticket that holds its
+        reservation until it's destroyed.  The ticket also marks the
+        calling thread as executing a scheduled run, so it must be
+        destroyed by that same thread.  If onWaiting returns false, the
+        run is taken out of the queue and a CancellationException is
+        thrown.
+
+        procedure and runId only identify the run in the status.
+    */
+    std::shared_ptr<void> admit(const Utf8String & procedure,
+                                const Utf8String & runId,
+                                const ProcedureRunConfig & config,
+                                const OnWaiting & onWaiting = nullptr);
+
+    /** Return whether the given run is waiting in the queue. */
+    bool isQueued(const Utf8String & procedure, const Utf8String & runId) const;
+
+    /** Return the limits, what is reserved, and the runs that are
+        executing and queued, in the order they will start.
+    */
+    Json::Value getStatus() const;
+
+private:
+    struct Entry;
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    ProcedureRunLimits limits;
+    double cpuCapacity;
+
+    std::list<std::shared_ptr<Entry> > queued;    ///< In order of starting
+    std::list<std::shared_ptr<Entry> > running;
+    uint64_t nextSequence;
+    double cpusReserved;
+    uint64_t memoryReserved;
+
+    uint64_t numStarted;
+    uint64_t numQueued;          ///< Runs that had to wait
+    double totalWaitSeconds;
+
+    /// Can the run at the head of the queue start?  Mutex must be held.
+    bool canStart(const Entry & entry) const;
+
+    void release(const std::shared_ptr<Entry> & entry);
+};
+
+} // namespace MLDB
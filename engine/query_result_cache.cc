@@ -0,0 +1,234 @@
+/** query_result_cache.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Cache of the results of queries.
+*/
+
+#include "mldb/engine/query_result_cache.h"
+#include "mldb/core/dataset.h"
+#include "mldb/core/mldb_engine.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* QUERY DEPENDENCY SCOPE                                                    */
+/*****************************************************************************/
+
+static __thread QueryDependencyScope * currentDependencyScope = nullptr;
+
+QueryDependencyScope::
+QueryDependencyScope()
+    : previous(currentDependencyScope)
+{
+    currentDependencyScope = this;
+}
+
+QueryDependencyScope::
+~QueryDependencyScope()
+{
+    currentDependencyScope = previous;
+
+    // What this scope saw is also a dependency of the enclosing one
+    if (previous) {
+        for (auto & d: datasets) {
+            auto dataset = d.first.lock();
+            bool found = false;
+            for (auto & p: previous->datasets)
+                found = found || p.first.lock() == dataset;
+            if (!found)
+                previous->datasets.push_back(d);
+        }
+        if (!cacheable)
+            previous->setUncacheable(uncacheableReason);
+    }
+}
+
+QueryDependencyScope *
+QueryDependencyScope::
+current()
+{
+    return currentDependencyScope;
+}
+
+void
+QueryDependencyScope::
+addDataset(const std::shared_ptr<Dataset> & dataset)
+{
+    if (!dataset)
+        return;
+    for (auto & d: datasets) {
+        if (d.first.lock() == dataset)
+            return;
+    }
+    datasets.emplace_back(dataset, dataset->getDataGeneration());
+}
+
+void
+QueryDependencyScope::
+setUncacheable(const Utf8String & reason)
+{
+    if (cacheable)
+        uncacheableReason = reason;
+    cacheable = false;
+}
+
+
+/*****************************************************************************/
+/* QUERY RESULT CACHE                                                        */
+/*****************************************************************************/
+
+QueryResultCache::
+QueryResultCache(size_t capacityBytes, double maxAgeSeconds)
+    : bytes_(0), capacityBytes_(capacityBytes), maxAgeSeconds_(maxAgeSeconds)
+{
+}
+
+std::shared_ptr<const QueryResultCache::Rows>
+QueryResultCache::
+getOrRun(const Utf8String & key,
+         const MldbEngine & engine,
+         const std::function<Rows ()> & run)
+{
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (capacityBytes_ == 0) {
+            guard.unlock();
+            return std::make_shared<const Rows>(run());
+        }
+
+        auto it = index.find(key);
+        if (it != index.end()) {
+            if (isCurrent(*it->second, engine, Date::now())) {
+                ++stats_.hits;
+                entries.splice(entries.begin(), entries, it->second);
+                return it->second->rows;
+            }
+            ++stats_.invalidations;
+            remove(it->second);
+        }
+        ++stats_.misses;
+    }
+
+    // The generations are read before the query runs, so that a change
+    // made while it's running makes its result stale rather than being
+    // missed.
+    Entry entry;
+    entry.key = key;
+    entry.created = Date::now();
+    entry.catalogGeneration = engine.getCatalogGeneration();
+
+    QueryDependencyScope dependencies;
+    auto rows = std::make_shared<const Rows>(run());
+
+    std::unique_lock<std::mutex> guard(mutex);
+    if (!dependencies.cacheable) {
+        ++stats_.uncacheable;
+        return rows;
+    }
+
+    entry.rows = rows;
+    entry.bytes = memusage(*rows) + key.rawLength();
+    entry.datasets = std::move(dependencies.datasets);
+
+    if (entry.bytes > capacityBytes_) {
+        ++stats_.tooLarge;
+        return rows;
+    }
+
+    // Another thread may have run the same query at the same time
+    auto it = index.find(key);
+    if (it != index.end())
+        remove(it->second);
+
+    bytes_ += entry.bytes;
+    entries.emplace_front(std::move(entry));
+    index[key] = entries.begin();
+
+    while (bytes_ > capacityBytes_) {
+        ++stats_.evictions;
+        remove(std::prev(entries.end()));
+    }
+
+    return rows;
+}
+
+bool
+QueryResultCache::
+isCurrent(const Entry & entry, const MldbEngine & engine, Date now) const
+{
+    if (now.secondsSince(entry.created) > maxAgeSeconds_)
+        return false;
+    if (engine.getCatalogGeneration() != entry.catalogGeneration)
+        return false;
+    for (auto & d: entry.datasets) {
+        auto dataset = d.first.lock();
+        if (!dataset || dataset->getDataGeneration() != d.second)
+            return false;
+    }
+    return true;
+}
+
+void
+QueryResultCache::
+remove(std::list<Entry>::iterator it)
+{
+    bytes_ -= it->bytes;
+    index.erase(it->key);
+    entries.erase(it);
+}
+
+void
+QueryResultCache::
+configure(size_t capacityBytes, double maxAgeSeconds)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    capacityBytes_ = capacityBytes;
+    maxAgeSeconds_ = maxAgeSeconds;
+    while (bytes_ > capacityBytes_) {
+        ++stats_.evictions;
+        remove(std::prev(entries.end()));
+    }
+}
+
+void
+QueryResultCache::
+clear()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    entries.clear();
+    index.clear();
+    bytes_ = 0;
+}
+
+QueryResultCacheStats
+QueryResultCache::
+stats() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    QueryResultCacheStats result = stats_;
+    result.entries = entries.size();
+    result.bytes = bytes_;
+    result.capacityBytes = capacityBytes_;
+    result.maxAgeSeconds = maxAgeSeconds_;
+    return result;
+}
+
+size_t
+QueryResultCache::
+memusage(const Rows & rows)
+{
+    size_t result = sizeof(Rows) + rows.capacity() * sizeof(MatrixNamedRow);
+    for (auto & row: rows) {
+        result += row.rowName.memusage();
+        result += row.columns.capacity() * sizeof(row.columns[0]);
+        for (auto & c: row.columns) {
+            result += std::get<0>(c).memusage();
+            result += std::get<1>(c).memusage();
+        }
+    }
+    return result;
+}
+
+} // namespace MLDB
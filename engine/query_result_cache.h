@@ -0,0 +1,153 @@
+/** query_result_cache.h                                           -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Cache of the results of queries, which are invalidated when a dataset
+    that they read changes.
+*/
+
+#pragma once
+
+#include "mldb/sql/dataset_types.h"
+#include "mldb/types/date.h"
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <functional>
+
+
+namespace MLDB {
+
+struct Dataset;
+struct MldbEngine;
+
+
+/*****************************************************************************/
+/* QUERY DEPENDENCY SCOPE                                                    */
+/*****************************************************************************/
+
+/** While this is alive, records the datasets that the queries bound by
+    this thread read, and whether they call anything (such as a user
+    function or now()) whose result can change while the datasets don't.
+    SqlExpressionMldbScope reports to the current scope as it looks up
+    datasets and functions.  Scopes can be nested; the innermost one is
+    told, and passes what it was told on to the one enclosing it when it
+    is destroyed.
+*/
+struct QueryDependencyScope {
+    QueryDependencyScope();
+    ~QueryDependencyScope();
+
+    QueryDependencyScope(const QueryDependencyScope &) = delete;
+    void operator = (const QueryDependencyScope &) = delete;
+
+    /// Return the scope that is active in this thread, or null if none
+    static QueryDependencyScope * current();
+
+    /// Record that the query reads the given dataset, along with the
+    /// generation of its data at this point.
+    void addDataset(const std::shared_ptr<Dataset> & dataset);
+
+    /// Record that the result of the query can't be reused
+    void setUncacheable(const Utf8String & reason);
+
+    /// Datasets read, with the data generation they had when first looked up
+    std::vector<std::pair<std::weak_ptr<Dataset>, uint64_t> > datasets;
+
+    /// False if something the query does makes its result not reusable
+    bool cacheable = true;
+
+    /// Why the result isn't cacheable, for debugging
+    Utf8String uncacheableReason;
+
+private:
+    QueryDependencyScope * previous;
+};
+
+
+/*****************************************************************************/
+/* QUERY RESULT CACHE                                                        */
+/*****************************************************************************/
+
+/** Statistics about the use of a QueryResultCache. */
+
+struct QueryResultCacheStats {
+    size_t entries = 0;         ///< Number of results currently cached
+    size_t bytes = 0;           ///< Approximate memory used by the results
+    size_t capacityBytes = 0;   ///< Maximum memory used by the results
+    double maxAgeSeconds = 0;   ///< Time after which a result is rerun
+    uint64_t hits = 0;          ///< Queries answered from the cache
+    uint64_t misses = 0;        ///< Queries that had to be run
+    uint64_t invalidations = 0; ///< Results dropped because they were stale
+    uint64_t evictions = 0;     ///< Results removed to make space
+    uint64_t uncacheable = 0;   ///< Queries whose result couldn't be kept
+    uint64_t tooLarge = 0;      ///< Results bigger than the whole cache
+};
+
+/** Cache of the rows returned by queries, bounded by the approximate
+    amount of memory that the rows use and evicting the least recently
+    used result first.
+
+    A cached result is used until one of these happens, after which the
+    query is run again:
+    - the data generation of a dataset it reads changes (because rows
+      were recorded in it or it was committed);
+    - the catalog generation of the engine changes (because a dataset or
+      function was created, replaced or deleted);
+    - it's older than the maximum age.
+
+    Queries that call user functions or non-deterministic builtins, or
+    that create datasets from a configuration, aren't cached.
+
+    A capacity of zero disables the cache; every query is run.
+*/
+
+struct QueryResultCache {
+    typedef std::vector<MatrixNamedRow> Rows;
+
+    QueryResultCache(size_t capacityBytes = 0, double maxAgeSeconds = 300);
+
+    /** Return the rows of the query identified by key, either from the
+        cache or by calling run.  The query must be run within the given
+        engine, whose catalog generation is checked.
+    */
+    std::shared_ptr<const Rows>
+    getOrRun(const Utf8String & key,
+             const MldbEngine & engine,
+             const std::function<Rows ()> & run);
+
+    /// Change the capacity and maximum age, evicting entries if necessary
+    void configure(size_t capacityBytes, double maxAgeSeconds);
+
+    /// Remove all entries.  The statistics are kept.
+    void clear();
+
+    QueryResultCacheStats stats() const;
+
+    /// Approximate memory used by the given rows
+    static size_t memusage(const Rows & rows);
+
+private:
+    struct Entry {
+        Utf8String key;
+        std::shared_ptr<const Rows> rows;
+        size_t bytes;
+        Date created;
+        uint64_t catalogGeneration;
+        std::vector<std::pair<std::weak_ptr<Dataset>, uint64_t> > datasets;
+    };
+
+    bool isCurrent(const Entry & entry, const MldbEngine & engine,
+                   Date now) const;
+    void remove(std::list<Entry>::iterator it);
+
+    mutable std::mutex mutex;
+    std::list<Entry> entries;
+    std::unordered_map<Utf8String, std::list<Entry>::iterator> index;
+    size_t bytes_;
+    size_t capacityBytes_;
+    double maxAgeSeconds_;
+    QueryResultCacheStats stats_;
+};
+
+} // namespace MLDB
@@ -0,0 +1,459 @@
+/** query_spill.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Spilling of the intermediate results of a query to disk.
+*/
+
+#include "mldb/engine/query_spill.h"
+#include "mldb/block/file_serializer.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/base/thread_pool.h"
+
+#include <cstring>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+size_t getQueryMemoryBudget()
+{
+    // This is read each time so that it can be changed while MLDB runs
+    const char * budget = getenv("MLDB_QUERY_MEMORY_BUDGET");
+    if (!budget || !*budget)
+        return 0;
+    char * end = nullptr;
+    unsigned long long result = strtoull(budget, &end, 10);
+    if (*end != 0) {
+        throw AnnotatedException
+            (400, "MLDB_QUERY_MEMORY_BUDGET must be a number of bytes",
+             "value", string(budget));
+    }
+    return result;
+}
+
+Utf8String getQuerySpillDirectory()
+{
+    const char * dir = getenv("MLDB_QUERY_SPILL_DIR");
+    if (!dir || !*dir)
+        return "/tmp";
+    return dir;
+}
+
+
+/*****************************************************************************/
+/* SPILL WRITER                                                              */
+/*****************************************************************************/
+
+namespace {
+
+enum SpilledValueType {
+    SPILLED_ATOM = 0,
+    SPILLED_EMBEDDING = 1,
+    SPILLED_ROW = 2,
+    SPILLED_SUPERPOSITION = 3
+};
+
+/** Is the given embedding storage type a plain number, whose buffer can
+    be spilled as its bytes?
+*/
+bool isNumericStorage(StorageType type)
+{
+    switch (type) {
+    case ST_FLOAT32: case ST_FLOAT64:
+    case ST_INT8:    case ST_UINT8:
+    case ST_INT16:   case ST_UINT16:
+    case ST_INT32:   case ST_UINT32:
+    case ST_INT64:   case ST_UINT64:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // file scope
+
+void
+SpillWriter::
+writeUnsigned(uint64_t val)
+{
+    while (val >= 128) {
+        bytes.push_back((char)(val & 127) | 128);
+        val >>= 7;
+    }
+    bytes.push_back((char)val);
+}
+
+void
+SpillWriter::
+write(const CellValue & val)
+{
+    size_t n = val.serializedBytes(false /* exactBytesAvailable */);
+    size_t start = bytes.size();
+    bytes.resize(start + n);
+    char * end = val.serialize(&bytes[start], n, false);
+    ExcAssertEqual(end, &bytes[start] + n);
+}
+
+void
+SpillWriter::
+write(Date ts)
+{
+    double secs = ts.secondsSinceEpoch();
+    bytes.append((const char *)&secs, sizeof(secs));
+}
+
+void
+SpillWriter::
+write(const PathElement & el)
+{
+    // Zero is a null element; otherwise it's the length plus one
+    if (el.null()) {
+        writeUnsigned(0);
+        return;
+    }
+    Utf8String str = el.toUtf8String();
+    writeUnsigned(str.rawLength() + 1);
+    bytes.append(str.rawData(), str.rawLength());
+}
+
+void
+SpillWriter::
+write(const Path & path)
+{
+    writeUnsigned(path.size());
+    for (size_t i = 0;  i < path.size();  ++i)
+        write(path[i]);
+}
+
+void
+SpillWriter::
+write(const ExpressionValue & val)
+{
+    if (val.isAtom()) {
+        writeUnsigned(SPILLED_ATOM);
+        write(val.getAtom());
+        write(val.getEffectiveTimestamp());
+    }
+    else if (val.isEmbedding()) {
+        writeUnsigned(SPILLED_EMBEDDING);
+        DimsVector shape = val.getEmbeddingShape();
+        writeUnsigned(shape.size());
+        for (auto & d: shape)
+            writeUnsigned(d);
+        // The storage type is kept, so that the embedding is read back
+        // with the same type
+        StorageType type = val.getEmbeddingType();
+        writeUnsigned(type);
+        if (isNumericStorage(type)) {
+            bytes.append((const char *)val.getEmbeddingData().get(),
+                         storageBufferBytes(shape, type));
+        }
+        else {
+            std::vector<CellValue> cells = val.getEmbeddingCell();
+            writeUnsigned(cells.size());
+            for (auto & c: cells)
+                write(c);
+        }
+        write(val.getEffectiveTimestamp());
+    }
+    else if (val.isRow()) {
+        writeUnsigned(SPILLED_ROW);
+        writeUnsigned(val.rowLength());
+        auto onColumn = [&] (const PathElement & name,
+                             const ExpressionValue & col)
+            {
+                write(name);
+                write(col);
+                return true;
+            };
+        val.forEachColumn(onColumn);
+    }
+    else {
+        std::vector<const ExpressionValue *> vals;
+        auto onValue = [&] (const ExpressionValue & v)
+            {
+                vals.push_back(&v);
+                return true;
+            };
+        val.forEachSuperposedValue(onValue);
+
+        writeUnsigned(SPILLED_SUPERPOSITION);
+        writeUnsigned(vals.size());
+        for (auto v: vals)
+            write(*v);
+    }
+}
+
+void
+SpillWriter::
+write(const std::vector<ExpressionValue> & vals)
+{
+    writeUnsigned(vals.size());
+    for (auto & v: vals)
+        write(v);
+}
+
+void
+SpillWriter::
+write(const NamedRowValue & row)
+{
+    write(row.rowName);
+    writeUnsigned(row.rowHash.hash());
+    writeUnsigned(row.columns.size());
+    for (auto & c: row.columns) {
+        write(std::get<0>(c));
+        write(std::get<1>(c));
+    }
+}
+
+
+/*****************************************************************************/
+/* SPILL READER                                                              */
+/*****************************************************************************/
+
+static void checkAvailable(const char * pos, const char * end, size_t n)
+{
+    if (end - pos < n) {
+        throw AnnotatedException
+            (500, "Attempt to read past the end of a spilled run");
+    }
+}
+
+uint64_t
+SpillReader::
+readUnsigned()
+{
+    uint64_t result = 0;
+    for (int shift = 0;  ;  shift += 7) {
+        checkAvailable(pos, end, 1);
+        unsigned char c = *pos++;
+        result |= uint64_t(c & 127) << shift;
+        if (c < 128)
+            return result;
+    }
+}
+
+CellValue
+SpillReader::
+readCell()
+{
+    checkAvailable(pos, end, 1);
+    auto res = CellValue::reconstitute
+        (pos, end - pos,
+         CellValue::serializationFormat(false /* exactBytesAvailable */),
+         false /* exactBytesAvailable */);
+    pos += res.second;
+    return std::move(res.first);
+}
+
+Date
+SpillReader::
+readDate()
+{
+    double secs;
+    checkAvailable(pos, end, sizeof(secs));
+    std::memcpy(&secs, pos, sizeof(secs));
+    pos += sizeof(secs);
+    return Date::fromSecondsSinceEpoch(secs);
+}
+
+PathElement
+SpillReader::
+readPathElement()
+{
+    uint64_t len = readUnsigned();
+    if (len == 0)
+        return PathElement();
+    len -= 1;
+    checkAvailable(pos, end, len);
+    PathElement result(pos, len);
+    pos += len;
+    return result;
+}
+
+Path
+SpillReader::
+readPath()
+{
+    uint64_t n = readUnsigned();
+    PathBuilder builder;
+    for (uint64_t i = 0;  i < n;  ++i)
+        builder.add(readPathElement());
+    return builder.extract();
+}
+
+ExpressionValue
+SpillReader::
+readExpressionValue()
+{
+    uint64_t type = readUnsigned();
+
+    switch (type) {
+    case SPILLED_ATOM: {
+        CellValue cell = readCell();
+        Date ts = readDate();
+        return ExpressionValue(std::move(cell), ts);
+    }
+    case SPILLED_EMBEDDING: {
+        DimsVector shape(readUnsigned());
+        size_t n = 1;
+        for (auto & d: shape) {
+            d = readUnsigned();
+            n *= d;
+        }
+        StorageType type = (StorageType)readUnsigned();
+        if (isNumericStorage(type)) {
+            size_t len = storageBufferBytes(n, type);
+            checkAvailable(pos, end, len);
+            auto data = allocateStorageBuffer(n, type);
+            std::memcpy(data.get(), pos, len);
+            pos += len;
+            Date ts = readDate();
+            return ExpressionValue::embedding(ts, std::move(data), type,
+                                              std::move(shape));
+        }
+
+        std::vector<CellValue> cells(readUnsigned());
+        for (auto & c: cells)
+            c = readCell();
+        Date ts = readDate();
+        if (type == ST_ATOM || type == ST_BLOB || type == ST_TIMEINTERVAL) {
+            // Blobs and time intervals can't be converted to from cells,
+            // so they stay as cells
+            return ExpressionValue(std::move(cells), ts, std::move(shape));
+        }
+        auto data = allocateStorageBuffer(cells.size(), type);
+        copyStorageBuffer(cells.data(), 0, ST_ATOM, data.get(), 0, type,
+                          cells.size());
+        return ExpressionValue::embedding(ts, std::move(data), type,
+                                          std::move(shape));
+    }
+    case SPILLED_ROW: {
+        size_t n = readUnsigned();
+        StructValue cols;
+        cols.reserve(n);
+        for (size_t i = 0;  i < n;  ++i) {
+            PathElement name = readPathElement();
+            cols.emplace_back(std::move(name), readExpressionValue());
+        }
+        return ExpressionValue(std::move(cols));
+    }
+    case SPILLED_SUPERPOSITION: {
+        std::vector<ExpressionValue> vals(readUnsigned());
+        for (auto & v: vals)
+            v = readExpressionValue();
+        return ExpressionValue::superpose(std::move(vals));
+    }
+    }
+
+    throw AnnotatedException(500, "Unknown spilled value type",
+                             "type", type);
+}
+
+std::vector<ExpressionValue>
+SpillReader::
+readExpressionValues()
+{
+    std::vector<ExpressionValue> result(readUnsigned());
+    for (auto & v: result)
+        v = readExpressionValue();
+    return result;
+}
+
+NamedRowValue
+SpillReader::
+readNamedRowValue()
+{
+    NamedRowValue result;
+    result.rowName = readPath();
+    result.rowHash = RowHash(readUnsigned());
+    size_t n = readUnsigned();
+    result.columns.reserve(n);
+    for (size_t i = 0;  i < n;  ++i) {
+        PathElement name = readPathElement();
+        result.columns.emplace_back(std::move(name), readExpressionValue());
+    }
+    return result;
+}
+
+
+/*****************************************************************************/
+/* SPILL FILE                                                                */
+/*****************************************************************************/
+
+static std::atomic<uint64_t> spillFileNumber(0);
+
+SpillFile::
+SpillFile(const Utf8String & directory)
+    : bytesWritten_(0)
+{
+    Utf8String filename
+        = directory + "/mldb-query-spill-" + to_string(getpid())
+        + "-" + to_string(spillFileNumber++);
+    serializer.reset(new FileSerializer(filename));
+
+    // The file stays open, so it can be removed from the directory straight
+    // away and its space will be returned once it's closed.
+    ::unlink(filename.rawData());
+}
+
+SpillFile::
+~SpillFile()
+{
+}
+
+FrozenMemoryRegion
+SpillFile::
+write(const SpillWriter & writer)
+{
+    if (writer.empty())
+        return FrozenMemoryRegion();
+
+    MutableMemoryRegion region
+        = serializer->allocateWritable(writer.size(), 1 /* alignment */);
+    std::memcpy(region.data(), writer.bytes.data(), writer.size());
+    bytesWritten_ += writer.size();
+    return region.freeze();
+}
+
+
+/*****************************************************************************/
+/* QUERY MEMORY BUDGET                                                       */
+/*****************************************************************************/
+
+QueryMemoryBudget::
+QueryMemoryBudget(size_t limit)
+    : limit(limit), used(0),
+      minRunBytes(std::max<size_t>(1, limit / (numCpus() + 1)))
+{
+}
+
+QueryMemoryBudget::
+~QueryMemoryBudget()
+{
+}
+
+SpillFile &
+QueryMemoryBudget::
+spillFile()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    if (!file)
+        file.reset(new SpillFile());
+    return *file;
+}
+
+bool
+QueryMemoryBudget::
+hasSpilled() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    return file && file->bytesWritten() > 0;
+}
+
+} // namespace MLDB
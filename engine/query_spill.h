@@ -0,0 +1,283 @@
+/** query_spill.h                                                   -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Spilling of the intermediate results of a query to disk.
+
+    Queries that sort or group their rows keep their intermediate results
+    in memory.  When a query has a memory budget and its intermediate
+    results grow beyond it, they are serialized into runs in a spill file.
+    The spill file is memory mapped, so the kernel can page the runs out
+    and a large query becomes slow rather than running out of memory.
+*/
+
+#pragma once
+
+#include "mldb/sql/expression_value.h"
+#include "mldb/block/memory_region.h"
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+
+namespace MLDB {
+
+struct FileSerializer;
+
+
+/** Return the number of bytes of intermediate results that a query may
+    keep in memory before it starts to spill them to disk.  This is read
+    from the MLDB_QUERY_MEMORY_BUDGET environment variable, in bytes, when
+    the query is run.  Zero (the default) means that there is no limit.
+*/
+size_t getQueryMemoryBudget();
+
+/** Return the directory in which spill files are created.  This is read
+    from the MLDB_QUERY_SPILL_DIR environment variable, and defaults to
+    /tmp.
+*/
+Utf8String getQuerySpillDirectory();
+
+
+/*****************************************************************************/
+/* SPILL WRITER                                                              */
+/*****************************************************************************/
+
+/** Serializes values into a buffer of bytes, ready to be written to a
+    spill file.  Values are read back by a SpillReader in the same order
+    that they were written.  The format is only for the lifetime of the
+    query, so it's not versioned.
+*/
+
+struct SpillWriter {
+    std::string bytes;
+
+    void writeUnsigned(uint64_t val);
+    void write(const CellValue & val);
+    void write(Date ts);
+    void write(const PathElement & el);
+    void write(const Path & path);
+    void write(const ExpressionValue & val);
+    void write(const std::vector<ExpressionValue> & vals);
+    void write(const NamedRowValue & row);
+
+    size_t size() const
+    {
+        return bytes.size();
+    }
+
+    bool empty() const
+    {
+        return bytes.empty();
+    }
+
+    void clear()
+    {
+        bytes.clear();
+    }
+};
+
+
+/*****************************************************************************/
+/* SPILL READER                                                              */
+/*****************************************************************************/
+
+/** Reads back values written by a SpillWriter. */
+
+struct SpillReader {
+    SpillReader(const char * start = nullptr, const char * end = nullptr)
+        : pos(start), end(end)
+    {
+    }
+
+    SpillReader(const FrozenMemoryRegion & region)
+        : pos(region.data()), end(region.data() + region.length())
+    {
+    }
+
+    const char * pos;
+    const char * end;
+
+    /// Have all values been read?
+    bool done() const
+    {
+        return pos == end;
+    }
+
+    uint64_t readUnsigned();
+    CellValue readCell();
+    Date readDate();
+    PathElement readPathElement();
+    Path readPath();
+    ExpressionValue readExpressionValue();
+    std::vector<ExpressionValue> readExpressionValues();
+    NamedRowValue readNamedRowValue();
+};
+
+
+/*****************************************************************************/
+/* SPILL FILE                                                                */
+/*****************************************************************************/
+
+/** Temporary file into which runs of serialized values are written.  The
+    file is removed from the directory as soon as it's created, so its
+    space is returned when it's destroyed even if the query fails.  The
+    regions it returns are only valid for its lifetime.
+
+    Writing is thread safe.
+*/
+
+struct SpillFile {
+    SpillFile(const Utf8String & directory = getQuerySpillDirectory());
+    ~SpillFile();
+
+    /// Write the contents of the writer as a run, returning its region
+    FrozenMemoryRegion write(const SpillWriter & writer);
+
+    /// Number of bytes written so far
+    size_t bytesWritten() const
+    {
+        return bytesWritten_;
+    }
+
+private:
+    std::unique_ptr<FileSerializer> serializer;
+    std::atomic<size_t> bytesWritten_;
+};
+
+
+/*****************************************************************************/
+/* QUERY MEMORY BUDGET                                                       */
+/*****************************************************************************/
+
+/** Accounts for the memory held by the intermediate results of a query,
+    over all of the threads that are working on it, and owns the spill
+    file once anything has been spilled.
+*/
+
+struct QueryMemoryBudget {
+    QueryMemoryBudget(size_t limit = getQueryMemoryBudget());
+    ~QueryMemoryBudget();
+
+    /// Maximum number of bytes to hold in memory; zero means no limit
+    size_t limit;
+
+    /// Bytes currently held in memory
+    std::atomic<size_t> used;
+
+    /// Is there a limit?  If not, nothing ever needs to be accounted for.
+    bool enabled() const
+    {
+        return limit != 0;
+    }
+
+    /// Is more memory held than the budget allows?
+    bool overBudget() const
+    {
+        return enabled() && used > limit;
+    }
+
+    /** Record that another n bytes are held, returning true if the
+        budget has been exceeded.
+    */
+    bool reserve(size_t n)
+    {
+        return (used += n) > limit && enabled();
+    }
+
+    /// Record that n bytes are no longer held
+    void release(size_t n)
+    {
+        used -= n;
+    }
+
+    /** When over budget, should a thread that holds the given number of
+        bytes spill them?  A thread only spills once it holds its share
+        of the budget, so that the runs don't get too small.
+    */
+    bool shouldSpill(size_t held) const
+    {
+        return overBudget() && held >= minRunBytes;
+    }
+
+    /// Return the spill file, creating it on first use
+    SpillFile & spillFile();
+
+    /// Has anything been spilled?
+    bool hasSpilled() const;
+
+private:
+    size_t minRunBytes;
+    mutable std::mutex mutex;
+    std::unique_ptr<SpillFile> file;
+};
+
+
+/*****************************************************************************/
+/* SORTED RUN MERGER                                                         */
+/*****************************************************************************/
+
+/** Merges a set of runs, each of which is already sorted, into a single
+    sorted sequence.  Each run is read by a cursor, which returns false
+    once the run is exhausted.  Values that are equal are returned in the
+    order of their runs, which keeps the merge deterministic.
+*/
+
+template<typename T, typename Less>
+struct SortedRunMerger {
+    typedef std::function<bool (T & value)> Cursor;
+
+    SortedRunMerger(std::vector<Cursor> cursors, Less less)
+        : cursors(std::move(cursors)), less(std::move(less)),
+          heads(this->cursors.size())
+    {
+        for (size_t i = 0;  i < this->cursors.size();  ++i) {
+            if (this->cursors[i](heads[i]))
+                heap.push_back(i);
+        }
+        std::make_heap(heap.begin(), heap.end(), heapOrder());
+    }
+
+    /** Move the next value in sorted order into value.  Returns false
+        once all runs are exhausted.
+    */
+    bool next(T & value)
+    {
+        if (heap.empty())
+            return false;
+        std::pop_heap(heap.begin(), heap.end(), heapOrder());
+        size_t run = heap.back();
+        value = std::move(heads[run]);
+        if (cursors[run](heads[run]))
+            std::push_heap(heap.begin(), heap.end(), heapOrder());
+        else heap.pop_back();
+        return true;
+    }
+
+private:
+    std::vector<Cursor> cursors;
+    Less less;
+    std::vector<T> heads;
+    std::vector<size_t> heap;
+
+    /// Puts the run with the first head at the top of the heap
+    struct HeapOrder {
+        const SortedRunMerger * merger;
+
+        bool operator () (size_t run1, size_t run2) const
+        {
+            const auto & heads = merger->heads;
+            if (merger->less(heads[run2], heads[run1]))
+                return true;
+            if (merger->less(heads[run1], heads[run2]))
+                return false;
+            return run1 > run2;
+        }
+    };
+
+    HeapOrder heapOrder() const
+    {
+        return { this };
+    }
+};
+
+} // namespace MLDB
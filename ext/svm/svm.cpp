@@ -58,6 +58,18 @@ static void info(const char *fmt,...)
 static void info(const char *fmt,...) {}
 #endif
 
+//
+// Parallel computation of kernel rows
+//
+static void serial_for(int begin, int end, svm_parallel_body body, void *context)
+{
+	body(context,begin,end);
+}
+static void (*svm_parallel_for)(int, int, svm_parallel_body, void *) = &serial_for;
+
+// rows shorter than this aren't worth splitting up
+static const int min_parallel_row = 1024;
+
 //
 // Kernel Cache
 //
@@ -212,15 +224,41 @@ public:
 	{
 		swap(x[i],x[j]);
 		if(x_square) swap(x_square[i],x_square[j]);
+		if(x_dense) swap(x_dense[i],x_dense[j]);
 	}
 protected:
 
 	double (Kernel::*kernel_function)(int i, int j) const;
 
+	// data[j] = K(i,j) for j in [start,len), times y[i]*y[j] if y is given
+	void fill_row(int i, Qfloat *data, int start, int len, const schar *y) const;
+
 private:
 	const svm_node **x;
 	double *x_square;
 
+	// Dense copy of x (rows of dim values) when the data is dense enough
+	// for it to be faster, or null
+	double **x_dense;
+	double *x_dense_data;
+	int dim;
+
+	struct row_job
+	{
+		const Kernel *kernel;
+		Qfloat *data;
+		int i;
+		const schar *y;
+	};
+	static void fill_row_range(void *context, int begin, int end);
+
+	static double dense_dot(const double *px, const double *py, int n);
+	double dot(int i, int j) const
+	{
+		if(x_dense) return dense_dot(x_dense[i],x_dense[j],dim);
+		return dot(x[i],x[j]);
+	}
+
 	// svm_parameter
 	const int kernel_type;
 	const int degree;
@@ -230,19 +268,19 @@ private:
 	static double dot(const svm_node *px, const svm_node *py);
 	double kernel_linear(int i, int j) const
 	{
-		return dot(x[i],x[j]);
+		return dot(i,j);
 	}
 	double kernel_poly(int i, int j) const
 	{
-		return powi(gamma*dot(x[i],x[j])+coef0,degree);
+		return powi(gamma*dot(i,j)+coef0,degree);
 	}
 	double kernel_rbf(int i, int j) const
 	{
-		return exp(-gamma*(x_square[i]+x_square[j]-2*dot(x[i],x[j])));
+		return exp(-gamma*(x_square[i]+x_square[j]-2*dot(i,j)));
 	}
 	double kernel_sigmoid(int i, int j) const
 	{
-		return tanh(gamma*dot(x[i],x[j])+coef0);
+		return tanh(gamma*dot(i,j)+coef0);
 	}
 	double kernel_precomputed(int i, int j) const
 	{
@@ -275,11 +313,40 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 
 	clone(x,x_,l);
 
+	// If at least half of the values are non-zero, the sparse dot product
+	// spends most of its time comparing indexes; a dense copy of the data
+	// is faster as long as it isn't too big.
+	x_dense = 0;
+	x_dense_data = 0;
+	dim = 0;
+	if(kernel_type != PRECOMPUTED)
+	{
+		long int nnz = 0;
+		for(int i=0;i<l;i++)
+			for(const svm_node *p = x[i]; p->index != -1; ++p, ++nnz)
+				dim = max(dim, p->index + 1);
+
+		if(nnz > 0 && 2 * nnz >= (long int)l * dim
+		   && (long int)l * dim <= (1L << 27))
+		{
+			x_dense_data = new double[(long int)l * dim];
+			x_dense = new double *[l];
+			for(int i=0;i<l;i++)
+			{
+				x_dense[i] = x_dense_data + (long int)i * dim;
+				for(int k=0;k<dim;k++)
+					x_dense[i][k] = 0;
+				for(const svm_node *p = x[i]; p->index != -1; ++p)
+					x_dense[i][p->index] = p->value;
+			}
+		}
+	}
+
 	if(kernel_type == RBF)
 	{
 		x_square = new double[l];
 		for(int i=0;i<l;i++)
-			x_square[i] = dot(x[i],x[i]);
+			x_square[i] = dot(i,i);
 	}
 	else
 		x_square = 0;
@@ -289,6 +356,51 @@ Kernel::~Kernel()
 {
 	delete[] x;
 	delete[] x_square;
+	delete[] x_dense;
+	delete[] x_dense_data;
+}
+
+double Kernel::dense_dot(const double *px, const double *py, int n)
+{
+	// independent sums so that the loop can be vectorized
+	double sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+	int k = 0;
+	for(;k+4<=n;k+=4)
+	{
+		sum0 += px[k] * py[k];
+		sum1 += px[k+1] * py[k+1];
+		sum2 += px[k+2] * py[k+2];
+		sum3 += px[k+3] * py[k+3];
+	}
+	for(;k<n;k++)
+		sum0 += px[k] * py[k];
+	return (sum0 + sum1) + (sum2 + sum3);
+}
+
+void Kernel::fill_row_range(void *context, int begin, int end)
+{
+	const row_job *job = (const row_job *)context;
+	const Kernel *kernel = job->kernel;
+	int i = job->i;
+	if(job->y)
+	{
+		for(int j=begin;j<end;j++)
+			job->data[j] = (Qfloat)(job->y[i]*job->y[j]*(kernel->*(kernel->kernel_function))(i,j));
+	}
+	else
+	{
+		for(int j=begin;j<end;j++)
+			job->data[j] = (Qfloat)(kernel->*(kernel->kernel_function))(i,j);
+	}
+}
+
+void Kernel::fill_row(int i, Qfloat *data, int start, int len, const schar *y) const
+{
+	row_job job = { this, data, i, y };
+	if(len - start < min_parallel_row)
+		fill_row_range(&job,start,len);
+	else
+		svm_parallel_for(start,len,&Kernel::fill_row_range,&job);
 }
 
 double Kernel::dot(const svm_node *px, const svm_node *py)
@@ -1279,12 +1391,9 @@ public:
 	Qfloat *get_Q(int i, int len) const
 	{
 		Qfloat *data;
-		int start, j;
+		int start;
 		if((start = cache->get_data(i,&data,len)) < len)
-		{
-			for(j=start;j<len;j++)
-				data[j] = (Qfloat)(y[i]*y[j]*(this->*kernel_function)(i,j));
-		}
+			fill_row(i,data,start,len,y);
 		return data;
 	}
 
@@ -1328,12 +1437,9 @@ public:
 	Qfloat *get_Q(int i, int len) const
 	{
 		Qfloat *data;
-		int start, j;
+		int start;
 		if((start = cache->get_data(i,&data,len)) < len)
-		{
-			for(j=start;j<len;j++)
-				data[j] = (Qfloat)(this->*kernel_function)(i,j);
-		}
+			fill_row(i,data,start,len,0);
 		return data;
 	}
 
@@ -1396,10 +1502,7 @@ public:
 		Qfloat *data;
 		int j, real_i = index[i];
 		if(cache->get_data(real_i,&data,l) < l)
-		{
-			for(j=0;j<l;j++)
-				data[j] = (Qfloat)(this->*kernel_function)(real_i,j);
-		}
+			fill_row(real_i,data,0,l,0);
 
 		// reorder and copy
 		Qfloat *buf = buffer[next_buffer];
@@ -3155,6 +3258,14 @@ int svm_check_probability_model(const svm_model *model)
 		 model->probA!=NULL);
 }
 
+void svm_set_parallel_for_function(void (*parallel_for)(int begin, int end, svm_parallel_body body, void *context))
+{
+	if(parallel_for == NULL)
+		svm_parallel_for = &serial_for;
+	else
+		svm_parallel_for = parallel_for;
+}
+
 void svm_set_print_string_function(void (*print_func)(const char *))
 {
 	if(print_func == NULL)
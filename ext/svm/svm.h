@@ -97,6 +97,13 @@ int svm_check_probability_model(const struct svm_model *model);
 
 void svm_set_print_string_function(void (*print_func)(const char *));
 
+/* Kernel rows are computed by calling body(context, begin, end) over
+   sub-ranges of [begin, end), which parallel_for may do concurrently.
+   By default they are computed serially.  Passing NULL restores the
+   default. */
+typedef void (*svm_parallel_body)(void *context, int begin, int end);
+void svm_set_parallel_for_function(void (*parallel_for)(int begin, int end, svm_parallel_body body, void *context));
+
 #ifdef __cplusplus
 }
 #endif
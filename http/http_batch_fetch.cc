@@ -0,0 +1,306 @@
+/** http_batch_fetch.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Fetch many URLs concurrently from a single thread, with curl's multi
+    interface.
+*/
+
+#include "mldb/http/http_batch_fetch.h"
+#include "mldb/http/http_rest_proxy.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/http/http_rest_proxy_impl.h"
+#include <curl/curl.h>
+#include <chrono>
+#include <climits>
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <unordered_map>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/// HTTP response codes that may go away if the request is tried again
+bool isRetryableResponse(long code)
+{
+    return code == 429 || code == 500 || code == 502 || code == 503
+        || code == 504;
+}
+
+/// Curl errors that may go away if the request is tried again
+bool isRetryableError(CURLcode code)
+{
+    switch (code) {
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_PARTIAL_FILE:
+    case CURLE_SSL_CONNECT_ERROR:
+    case CURLE_HTTP2:
+    case CURLE_HTTP2_STREAM:
+        return true;
+    default:
+        return false;
+    }
+}
+
+size_t appendBody(char * data, size_t size, size_t n, void * userdata)
+{
+    static_cast<std::string *>(userdata)->append(data, size * n);
+    return size * n;
+}
+
+/// One request handle, which is reused for request after request
+struct Transfer {
+    Transfer()
+        : handle(curl_easy_init())
+    {
+        ExcAssert(handle);
+    }
+
+    ~Transfer()
+    {
+        if (multi)
+            curl_multi_remove_handle(multi, handle);
+        curl_easy_cleanup(handle);
+    }
+
+    CURL * handle;
+    CURLM * multi = nullptr;   ///< Multi handle it's been added to, if any
+    size_t index = 0;
+    HttpBatchFetchResult result;
+};
+
+/// Requests to one host that are waiting to start
+struct HostQueue {
+    std::deque<size_t> pending;
+    int inFlight = 0;
+    Clock::time_point nextStart;
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* HTTP BATCH FETCH                                                          */
+/*****************************************************************************/
+
+void httpBatchFetch(const std::vector<std::string> & urls,
+                    const HttpBatchFetchOptions & options,
+                    const OnHttpFetchDone & onDone)
+{
+    if (urls.empty())
+        return;
+
+    std::unique_ptr<CURLM, CURLMcode (*) (CURLM *)>
+        multi(curl_multi_init(), &curl_multi_cleanup);
+    ExcAssert(multi);
+    curl_multi_setopt(multi.get(), CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    HttpConnectionPoolConfig poolConfig = getHttpConnectionPoolConfig();
+    CURLSH * share = getHttpConnectionPoolShare();
+
+    size_t maxInFlight = options.maxInFlight > 0 ? options.maxInFlight : INT_MAX;
+    int maxPerHost = options.maxInFlightPerHost;
+    auto startInterval = std::chrono::duration_cast<Clock::duration>
+        (std::chrono::duration<double>
+         (options.maxRequestsPerSecondPerHost > 0
+          ? 1.0 / options.maxRequestsPerSecondPerHost : 0.0));
+
+    std::vector<std::string> hostOf(urls.size());
+    std::vector<int> attempts(urls.size(), 0);
+    std::map<std::string, HostQueue> hosts;
+    for (size_t i = 0;  i < urls.size();  ++i) {
+        hostOf[i] = getHttpHostKey(urls[i]);
+        hosts[hostOf[i]].pending.push_back(i);
+    }
+
+    // Requests waiting out their backoff, by when they can be tried again
+    std::multimap<Clock::time_point, size_t> retries;
+    std::minstd_rand jitter(urls.size());
+
+    // The transfers are declared after the multi handle, so that they're
+    // removed from it before it's destroyed
+    std::vector<std::unique_ptr<Transfer> > idle;
+    std::unordered_map<CURL *, std::unique_ptr<Transfer> > active;
+
+    auto start = [&] (size_t index)
+        {
+            std::unique_ptr<Transfer> transfer;
+            if (idle.empty())
+                transfer.reset(new Transfer());
+            else {
+                transfer = std::move(idle.back());
+                idle.pop_back();
+            }
+
+            transfer->index = index;
+            transfer->result = HttpBatchFetchResult();
+            transfer->result.attempts = ++attempts[index];
+
+            CURL * handle = transfer->handle;
+            curl_easy_setopt(handle, CURLOPT_URL, urls[index].c_str());
+            curl_easy_setopt(handle, CURLOPT_SHARE, share);
+            curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+            curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+            curl_easy_setopt(handle, CURLOPT_MAXREDIRS, 20L);
+            curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, 20L);
+            curl_easy_setopt(handle, CURLOPT_FILETIME, 1L);
+            curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+            curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT,
+                             (long)poolConfig.dnsCacheSeconds);
+            curl_easy_setopt(handle, CURLOPT_HTTP_VERSION,
+                             poolConfig.http2
+                             ? (long)CURL_HTTP_VERSION_2TLS
+                             : (long)CURL_HTTP_VERSION_1_1);
+            if (options.stallTimeoutSeconds > 0) {
+                curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT, 1L);
+                curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME,
+                                 std::max(1L,
+                                          (long)options.stallTimeoutSeconds));
+            }
+            curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, &appendBody);
+            curl_easy_setopt(handle, CURLOPT_WRITEDATA,
+                             &transfer->result.body);
+
+            CURLMcode code = curl_multi_add_handle(multi.get(), handle);
+            if (code != CURLM_OK)
+                throw MLDB::Exception(std::string("Couldn't start fetch: ")
+                                      + curl_multi_strerror(code));
+            transfer->multi = multi.get();
+            active[handle] = std::move(transfer);
+        };
+
+    auto finish = [&] (CURL * handle, CURLcode code, Clock::time_point now)
+        {
+            auto it = active.find(handle);
+            ExcAssert(it != active.end());
+            std::unique_ptr<Transfer> transfer = std::move(it->second);
+            active.erase(it);
+
+            curl_multi_remove_handle(multi.get(), handle);
+            transfer->multi = nullptr;
+
+            size_t index = transfer->index;
+            HttpBatchFetchResult & result = transfer->result;
+            --hosts[hostOf[index]].inFlight;
+
+            bool retryable;
+            if (code == CURLE_OK) {
+                curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE,
+                                  &result.responseCode);
+                curl_off_t fileTime = -1;
+                curl_easy_getinfo(handle, CURLINFO_FILETIME_T, &fileTime);
+                if (fileTime >= 0)
+                    result.lastModified
+                        = Date::fromSecondsSinceEpoch(fileTime);
+                retryable = isRetryableResponse(result.responseCode);
+            }
+            else {
+                result.errorCode = code;
+                result.errorMessage = curl_easy_strerror(code);
+                retryable = isRetryableError(code);
+            }
+
+            if (retryable && result.attempts <= options.maxRetries) {
+                // Exponential backoff, with a little jitter so that retries
+                // of requests that failed together are spread out
+                double wait = options.retryBackoffSeconds
+                    * (1 << std::min(result.attempts - 1, 20))
+                    * std::uniform_real_distribution<double>(1.0, 1.25)(jitter);
+                retries.emplace(now + std::chrono::duration_cast<Clock::duration>
+                                (std::chrono::duration<double>(wait)),
+                                index);
+            }
+            else {
+                onDone(index, result);
+            }
+
+            curl_easy_reset(handle);
+            idle.emplace_back(std::move(transfer));
+        };
+
+    size_t remaining = urls.size();
+    std::vector<std::pair<CURL *, CURLcode> > done;
+
+    while (remaining > 0) {
+        auto now = Clock::now();
+
+        // Retries whose backoff is over go to the front of their host's queue
+        while (!retries.empty() && retries.begin()->first <= now) {
+            size_t index = retries.begin()->second;
+            retries.erase(retries.begin());
+            hosts[hostOf[index]].pending.push_front(index);
+        }
+
+        auto wakeUp = now + std::chrono::milliseconds(100);
+        if (!retries.empty())
+            wakeUp = std::min(wakeUp, retries.begin()->first);
+
+        // Start as many requests as the limits allow, taking one from each
+        // host in turn so that one busy host doesn't hold up the others
+        for (bool started = true;  started && active.size() < maxInFlight;) {
+            started = false;
+            for (auto & h: hosts) {
+                HostQueue & host = h.second;
+                if (active.size() >= maxInFlight)
+                    break;
+                if (host.pending.empty()
+                    || (maxPerHost > 0 && host.inFlight >= maxPerHost))
+                    continue;
+                if (host.nextStart > now) {
+                    wakeUp = std::min(wakeUp, host.nextStart);
+                    continue;
+                }
+
+                size_t index = host.pending.front();
+                host.pending.pop_front();
+                ++host.inFlight;
+                host.nextStart = std::max(host.nextStart, now) + startInterval;
+                start(index);
+                started = true;
+            }
+        }
+
+        int running = 0;
+        curl_multi_perform(multi.get(), &running);
+
+        // Collect the finished requests first, since finishing them changes
+        // the multi handle
+        done.clear();
+        int left = 0;
+        while (CURLMsg * msg = curl_multi_info_read(multi.get(), &left)) {
+            if (msg->msg == CURLMSG_DONE)
+                done.emplace_back(msg->easy_handle, msg->data.result);
+        }
+
+        now = Clock::now();
+        for (auto & d: done) {
+            size_t before = retries.size();
+            finish(d.first, d.second, now);
+            if (retries.size() == before)
+                --remaining;
+        }
+
+        if (remaining == 0 || !done.empty())
+            continue;
+
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>
+            (wakeUp - Clock::now()).count();
+        curl_multi_poll(multi.get(), nullptr, 0, std::max<long>(0, wait),
+                        nullptr);
+    }
+}
+
+} // namespace MLDB
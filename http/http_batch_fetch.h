@@ -0,0 +1,82 @@
+/** http_batch_fetch.h                                              -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Fetch many URLs concurrently from a single thread.
+*/
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "mldb/types/date.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HTTP BATCH FETCH                                                          */
+/*****************************************************************************/
+
+struct HttpBatchFetchOptions {
+    /// Most requests in flight at once; zero is unlimited
+    int maxInFlight = 64;
+
+    /// Most requests in flight to one host (scheme, name and port) at once;
+    /// zero is unlimited
+    int maxInFlightPerHost = 0;
+
+    /// Most requests started per second to one host; zero is unlimited
+    double maxRequestsPerSecondPerHost = 0;
+
+    /// Number of times to try again after a connection error, a timeout or
+    /// an HTTP 429, 500, 502, 503 or 504 response
+    int maxRetries = 0;
+
+    /// Wait before the first retry; it doubles for each one after
+    double retryBackoffSeconds = 0.5;
+
+    /// Abort a request that has received nothing for this long
+    double stallTimeoutSeconds = 60;
+};
+
+struct HttpBatchFetchResult {
+    /// HTTP response code, or zero if there was no response
+    long responseCode = 0;
+
+    /// Curl error code of the last attempt, or zero if it got a response
+    int errorCode = 0;
+
+    /// Message describing errorCode
+    std::string errorMessage;
+
+    /// Body of the response, including for error responses
+    std::string body;
+
+    /// Last-Modified time of the response, if the server gave one
+    Date lastModified = Date::notADate();
+
+    /// Number of attempts that were made
+    int attempts = 0;
+};
+
+/** Called once for each URL, with its index, as soon as it's done. */
+typedef std::function<void (size_t index, HttpBatchFetchResult & result)>
+OnHttpFetchDone;
+
+/** Fetch each of the given http:// or https:// URLs with a GET, following
+    redirects, and call onDone for each one as it finishes.
+
+    All of the requests are driven from the calling thread with curl's multi
+    interface, so hundreds can be in flight without blocking a thread each.
+    Connections, host name lookups and TLS sessions come from the same pool
+    as HttpRestProxy, and requests to the same HTTP/2 server share its
+    connections.  onDone is called on the calling thread; if it throws, the
+    requests in flight are abandoned and the exception is passed on.
+*/
+void httpBatchFetch(const std::vector<std::string> & urls,
+                    const HttpBatchFetchOptions & options,
+                    const OnHttpFetchDone & onDone);
+
+} // namespace MLDB
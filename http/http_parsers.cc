@@ -8,6 +8,7 @@
 #include <string.h>
 #include <strings.h>
 #include <iostream>
+#include <optional>
 #include "base/exc_assert.h"
 #include "mldb/arch/exception.h"
 #include "mldb/base/parse_context.h"
@@ -225,9 +226,11 @@ parseHeaders(BufferState & state)
     string multiline;
     unsigned int numLines(0);
 
-    std::unique_ptr<ParseContext::Revert_Token> token;
+    // Constructed in place for each line, so that parsing the headers
+    // doesn't allocate
+    std::optional<ParseContext::Revert_Token> token;
 
-    token.reset(new ParseContext::Revert_Token(state));
+    token.emplace(state);
 
     /* header line parsing */
     while (*state != '\r' || numLines > 0) {
@@ -264,7 +267,7 @@ parseHeaders(BufferState & state)
                 numLines = 0;
             }
             token->ignore();
-            token.reset(new ParseContext::Revert_Token(state));
+            token.emplace(state);
         }
     }
     if (state.get_offset() + 1 == state.total_buffered()) {
@@ -10,11 +10,14 @@
 #include <curl/curl.h>
 #include "mldb/arch/threads.h"
 #include <chrono>
+#include <condition_variable>
 #include <thread>
+#include <unordered_map>
 #include "mldb/types/structure_description.h"
 #include "curl_wrapper.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/ext/jsoncpp/json.h"
+#include <boost/lexical_cast.hpp>
 
 #include "http_rest_proxy.h"
 #include "http_rest_proxy_impl.h"
@@ -154,6 +157,227 @@ urlEncode(const Utf8String & str)
 }
 
 
+/*****************************************************************************/
+/* HTTP CONNECTION POOL                                                      */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(HttpConnectionPoolConfig);
+
+HttpConnectionPoolConfigDescription::
+HttpConnectionPoolConfigDescription()
+{
+    HttpConnectionPoolConfig defaults;
+
+    addField("maxConnectionsPerHost",
+             &HttpConnectionPoolConfig::maxConnectionsPerHost,
+             "Most requests in flight to one host at once; zero is unlimited",
+             defaults.maxConnectionsPerHost);
+    addField("maxIdleConnections",
+             &HttpConnectionPoolConfig::maxIdleConnections,
+             "Most open connections kept for reuse",
+             defaults.maxIdleConnections);
+    addField("dnsCacheSeconds", &HttpConnectionPoolConfig::dnsCacheSeconds,
+             "How long host name lookups are kept for, in seconds",
+             defaults.dnsCacheSeconds);
+    addField("http2", &HttpConnectionPoolConfig::http2,
+             "Negotiate HTTP/2 with servers that support it over TLS",
+             defaults.http2);
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(HttpConnectionPoolStats);
+
+HttpConnectionPoolStatsDescription::
+HttpConnectionPoolStatsDescription()
+{
+    addField("requests", &HttpConnectionPoolStats::requests,
+             "Requests performed");
+    addField("connectionsOpened", &HttpConnectionPoolStats::connectionsOpened,
+             "New connections opened; the other requests reused one");
+    addField("waits", &HttpConnectionPoolStats::waits,
+             "Requests that waited for another to the same host to finish");
+    addField("idleHandles", &HttpConnectionPoolStats::idleHandles,
+             "Request handles ready for reuse");
+}
+
+namespace {
+
+/// Read an option of the connection pool from the environment
+template<typename T>
+void getPoolOption(const char * name, T & value)
+{
+    const char * str = ::getenv(name);
+    if (!str || !*str)
+        return;
+    try {
+        value = boost::lexical_cast<T>(str);
+    } catch (const boost::bad_lexical_cast &) {
+        throw MLDB::Exception(std::string("Couldn't parse environment variable ")
+                              + name + " value '" + str + "'");
+    }
+}
+
+/// Most request handles kept for reuse, whatever the other options are
+constexpr size_t MAX_IDLE_HANDLES = 64;
+
+} // file scope
+
+/** State shared by every HttpRestProxy: a curl share handle, which keeps
+    open connections, host name lookups and TLS sessions, the request
+    handles that aren't in use, and the number of requests in flight to
+    each host.
+*/
+struct HttpRestProxy::SharedPool {
+    SharedPool()
+        : share(curl_share_init())
+    {
+        ExcAssert(share);
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, &lockShare);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, &unlockShare);
+        curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+        getPoolOption("MLDB_HTTP_MAX_CONNECTIONS_PER_HOST",
+                      config.maxConnectionsPerHost);
+        getPoolOption("MLDB_HTTP_MAX_IDLE_CONNECTIONS",
+                      config.maxIdleConnections);
+        getPoolOption("MLDB_HTTP_DNS_CACHE_SECONDS", config.dnsCacheSeconds);
+        getPoolOption("MLDB_HTTP2", config.http2);
+    }
+
+    // Never destroyed, so that proxies in static objects can still use it
+    static SharedPool & get()
+    {
+        static SharedPool * pool = new SharedPool();
+        return *pool;
+    }
+
+    CURLSH * share;
+    std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+
+    static void lockShare(CURL *, curl_lock_data data, curl_lock_access,
+                          void * userptr)
+    {
+        static_cast<SharedPool *>(userptr)->shareLocks[data].lock();
+    }
+
+    static void unlockShare(CURL *, curl_lock_data data, void * userptr)
+    {
+        static_cast<SharedPool *>(userptr)->shareLocks[data].unlock();
+    }
+
+    std::mutex lock;
+    std::condition_variable hostFreed;
+    HttpConnectionPoolConfig config;
+    HttpConnectionPoolStats stats;
+    std::vector<std::unique_ptr<ConnectionHandler> > idle;
+    std::unordered_map<std::string, int> inFlight;
+
+    ConnectionHandler * getHandler()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (idle.empty())
+            return new ConnectionHandler();
+        ConnectionHandler * result = idle.back().release();
+        idle.pop_back();
+        return result;
+    }
+
+    void doneHandler(ConnectionHandler * conn)
+    {
+        std::unique_ptr<ConnectionHandler> handler(conn);
+        handler->reset();
+        std::unique_lock<std::mutex> guard(lock);
+        if (idle.size() < MAX_IDLE_HANDLES)
+            idle.emplace_back(std::move(handler));
+    }
+
+    /** Wait until a request can be made to the given host, for up to the
+        given timeout (-1 is forever), and return false if it timed out.
+    */
+    bool startRequest(const std::string & host, double timeout)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        ++stats.requests;
+        int & n = inFlight[host];
+        if (config.maxConnectionsPerHost > 0
+            && n >= config.maxConnectionsPerHost) {
+            ++stats.waits;
+            auto ready = [&] ()
+                {
+                    return config.maxConnectionsPerHost <= 0
+                        || n < config.maxConnectionsPerHost;
+                };
+            if (timeout < 0)
+                hostFreed.wait(guard, ready);
+            else if (!hostFreed.wait_for
+                     (guard, std::chrono::duration<double>(timeout), ready))
+                return false;
+        }
+        ++n;
+        return true;
+    }
+
+    void finishRequest(const std::string & host, long connectionsOpened)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            stats.connectionsOpened += connectionsOpened;
+            auto it = inFlight.find(host);
+            ExcAssert(it != inFlight.end());
+            if (--it->second == 0)
+                inFlight.erase(it);
+        }
+        hostFreed.notify_all();
+    }
+};
+
+HttpConnectionPoolConfig getHttpConnectionPoolConfig()
+{
+    auto & pool = HttpRestProxy::SharedPool::get();
+    std::unique_lock<std::mutex> guard(pool.lock);
+    return pool.config;
+}
+
+void setHttpConnectionPoolConfig(const HttpConnectionPoolConfig & config)
+{
+    if (config.maxConnectionsPerHost < 0 || config.maxIdleConnections < 0
+        || config.dnsCacheSeconds < 0)
+        throw MLDB::Exception("HTTP connection pool limits can't be negative");
+
+    auto & pool = HttpRestProxy::SharedPool::get();
+    {
+        std::unique_lock<std::mutex> guard(pool.lock);
+        pool.config = config;
+    }
+    // A higher limit may let waiting requests through
+    pool.hostFreed.notify_all();
+}
+
+CURLSH * getHttpConnectionPoolShare()
+{
+    return HttpRestProxy::SharedPool::get().share;
+}
+
+std::string getHttpHostKey(const std::string & uri)
+{
+    size_t start = uri.find("://");
+    start = (start == std::string::npos ? 0 : start + 3);
+    size_t end = uri.find_first_of("/?#", start);
+    return std::string(uri, 0, end);
+}
+
+HttpConnectionPoolStats getHttpConnectionPoolStats()
+{
+    auto & pool = HttpRestProxy::SharedPool::get();
+    std::unique_lock<std::mutex> guard(pool.lock);
+    HttpConnectionPoolStats result = pool.stats;
+    result.idleHandles = pool.idle.size();
+    return result;
+}
+
+
 /*****************************************************************************/
 /* HTTP REST PROXY                                                           */
 /*****************************************************************************/
@@ -178,43 +402,21 @@ struct HttpRestProxy::Itl {
 
     HttpRestProxy * owner;
 
-    /** Lock for connection pool. */
-    mutable std::mutex lock;
-
-    /** List of inactive handles.  These can be selected from when a new
-        connection needs to be made.
-    */
-    mutable std::vector<Connection> inactive;
-
     std::vector<std::string> cookies;
 
+    /** Handles come from the pool shared by all proxies, so that they
+        don't need to open a new connection to a host that another proxy
+        has used.
+    */
     HttpRestProxy::Connection
     getConnection() const
     {
-        std::unique_lock<std::mutex> guard(lock);
-
-        if (inactive.empty()) {
-            return Connection(new ConnectionHandler, owner);
-        }
-        else {
-            Connection res(std::move(inactive.back()));
-            inactive.pop_back();
-
-            // Set proxy to this, so when it's destroyed it's put on our list
-            ExcAssert(res.proxy == nullptr);
-            res.proxy = owner;
-            return res;
-        }
+        return Connection(SharedPool::get().getHandler(), owner);
     }
     
     void doneConnection(ConnectionHandler * conn)
     {
-        std::unique_lock<std::mutex> guard(lock);
-        conn->reset();
-
-        // Put a Connection with a null handler on the list so it's
-        // destroyed when done
-        inactive.emplace_back(conn, nullptr);
+        SharedPool::get().doneHandler(conn);
     }
 };
 
@@ -326,6 +528,19 @@ perform(const std::string & verb,
 
         uri = itl->serviceUri + resource + queryParams.uriEscaped();
 
+        auto & pool = SharedPool::get();
+        HttpConnectionPoolConfig poolConfig = getHttpConnectionPoolConfig();
+
+        myRequest.add_data_option(CURLOPT_SHARE, pool.share);
+        myRequest.add_option(CURLOPT_MAXCONNECTS,
+                             (long)poolConfig.maxIdleConnections);
+        myRequest.add_option(CURLOPT_DNS_CACHE_TIMEOUT,
+                             (long)poolConfig.dnsCacheSeconds);
+        myRequest.add_option(CURLOPT_HTTP_VERSION,
+                             poolConfig.http2
+                             ? (long)CURL_HTTP_VERSION_2TLS
+                             : (long)CURL_HTTP_VERSION_1_1);
+
         myRequest.add_option(CURLOPT_CUSTOMREQUEST, verb);
 
         myRequest.add_option(CURLOPT_URL, uri);
@@ -429,7 +644,25 @@ perform(const std::string & verb,
 
         myRequest.add_header_option(curlHeaders);
 
+        std::string host = getHttpHostKey(uri);
+        if (!pool.startRequest(host, timeout)) {
+            if (!exceptions) {
+                response.errorCode_ = CURLE_OPERATION_TIMEDOUT;
+                response.errorMessage_
+                    = "timed out waiting for a connection to " + host;
+                return response;
+            }
+            throw CurlWrapper::RuntimeError("waiting for a connection to "
+                                            + host, CURLE_OPERATION_TIMEDOUT);
+        }
+
         CURLcode code = myRequest.perform();
+
+        long connectionsOpened = 0;
+        curl_easy_getinfo((CURL *)myRequest, CURLINFO_NUM_CONNECTS,
+                          &connectionsOpened);
+        pool.finishRequest(host, connectionsOpened);
+
         response.body_ = body;
         if (code != CURLE_OK) {
             if (!exceptions) {
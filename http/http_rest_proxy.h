@@ -10,6 +10,7 @@
 #include <mutex>
 #include <functional>
 #include "mldb/http/http_header.h"
+#include "mldb/types/value_description_fwd.h"
 
 namespace Json {
 struct Value;
@@ -140,6 +141,56 @@ private:
 };
 
 
+/*****************************************************************************/
+/* HTTP CONNECTION POOL                                                      */
+/*****************************************************************************/
+
+/** Options of the connection pool that is shared by every HttpRestProxy in
+    the process.  Open connections, host name lookups and TLS sessions are
+    kept in the pool, so that a request to a host that was recently used
+    doesn't need a new handshake, whichever HttpRestProxy makes it.
+
+    The initial values come from the MLDB_HTTP_MAX_CONNECTIONS_PER_HOST,
+    MLDB_HTTP_MAX_IDLE_CONNECTIONS, MLDB_HTTP_DNS_CACHE_SECONDS and
+    MLDB_HTTP2 environment variables.
+*/
+struct HttpConnectionPoolConfig {
+    /// Most requests in flight to one host (scheme, name and port) at once;
+    /// others wait for one to finish.  Zero is unlimited.
+    int maxConnectionsPerHost = 0;
+
+    /// Most open connections kept for reuse once their request is done
+    int maxIdleConnections = 256;
+
+    /// How long host name lookups are kept for
+    double dnsCacheSeconds = 300;
+
+    /// Negotiate HTTP/2 with servers that support it over TLS
+    bool http2 = true;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(HttpConnectionPoolConfig);
+
+/// Counters of the shared connection pool, since the process started
+struct HttpConnectionPoolStats {
+    uint64_t requests = 0;          ///< Requests performed
+    uint64_t connectionsOpened = 0; ///< New connections; the rest were reused
+    uint64_t waits = 0;             ///< Requests that waited for their host
+    int idleHandles = 0;            ///< Request handles ready for reuse
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(HttpConnectionPoolStats);
+
+HttpConnectionPoolConfig getHttpConnectionPoolConfig();
+
+/** Change the options of the shared connection pool.  Requests that are
+    already in flight keep the old options.
+*/
+void setHttpConnectionPoolConfig(const HttpConnectionPoolConfig & config);
+
+HttpConnectionPoolStats getHttpConnectionPoolStats();
+
+
 /*****************************************************************************/
 /* HTTP REST PROXY                                                           */
 /*****************************************************************************/
@@ -231,8 +282,14 @@ private:
     /** Private type that implements a connection handler. */
     struct ConnectionHandler;
     struct Itl;
+    struct SharedPool;
     std::unique_ptr<Itl> itl;
 
+    friend HttpConnectionPoolConfig getHttpConnectionPoolConfig();
+    friend void setHttpConnectionPoolConfig(const HttpConnectionPoolConfig &);
+    friend HttpConnectionPoolStats getHttpConnectionPoolStats();
+    friend void * getHttpConnectionPoolShare();  // returns a CURLSH *
+
     void doneConnection(ConnectionHandler * conn);
 };
 
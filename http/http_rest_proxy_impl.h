@@ -67,5 +67,17 @@ private:
     HttpRestProxy * proxy;
 };
 
+/** Curl share handle of the connection pool used by every HttpRestProxy,
+    for internal users that drive curl themselves.  Easy handles that use
+    it share open connections, host name lookups and TLS sessions with the
+    proxies.
+*/
+CURLSH * getHttpConnectionPoolShare();
+
+/** Return the scheme, host and port of a URI, which is what the pool
+    limits requests by.
+*/
+std::string getHttpHostKey(const std::string & uri);
+
 
 } // namespace MLDB
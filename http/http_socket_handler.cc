@@ -67,7 +67,8 @@ HttpResponse(int responseCode,
 
 HttpSocketHandler::
 HttpSocketHandler(TcpSocket socket)
-    : TcpSocketHandler(std::move(socket))
+    : TcpSocketHandler(std::move(socket)),
+      receivePaused_(false), receiveStalled_(false)
 {
     parser_.onRequestStart = [&] (const char * methodData, size_t methodSize,
                                   const char * urlData, size_t urlSize,
@@ -104,10 +105,38 @@ onReceivedData(const char * data, size_t size)
 {
     try {
         parser_.feed(data, size);
-        requestReceive();
     }
     catch (const MLDB::Exception & exc) {
         requestClose();
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard(receiveMutex_);
+    if (receivePaused_) {
+        receiveStalled_ = true;
+    }
+    else {
+        requestReceive();
+    }
+}
+
+void
+HttpSocketHandler::
+pauseReceiving()
+{
+    std::unique_lock<std::mutex> guard(receiveMutex_);
+    receivePaused_ = true;
+}
+
+void
+HttpSocketHandler::
+resumeReceiving()
+{
+    std::unique_lock<std::mutex> guard(receiveMutex_);
+    receivePaused_ = false;
+    if (receiveStalled_) {
+        receiveStalled_ = false;
+        requestReceive();
     }
 }
 
@@ -131,10 +160,13 @@ onReceiveError(const boost::system::error_code & ec, size_t bufferSize)
 
 HttpLegacySocketHandler::
 HttpLegacySocketHandler(TcpSocket && socket)
-    : HttpSocketHandler(std::move(socket)), bodyStarted_(false)
+    : HttpSocketHandler(std::move(socket)), bodyStarted_(false),
+      responsePending_(false)
 {
 }
 
+constexpr size_t HttpLegacySocketHandler::MAX_QUEUED_REQUESTS;
+
 void
 HttpLegacySocketHandler::
 send(std::string str,
@@ -161,13 +193,43 @@ send(std::string str,
 
 void
 HttpLegacySocketHandler::
-putResponseOnWire(const HttpResponse & response,
-                  std::function<void ()> onSendFinished,
-                  NextAction next)
+send(vector<WriteBuffer> buffers,
+     NextAction action, OnWriteFinished onWriteFinished)
 {
-    string responseStr;
-    responseStr.reserve(16384 + response.body.length());
+    size_t size = 0;
+    for (auto & b: buffers) {
+        size += b.size;
+    }
+
+    if (size > 0) {
+        auto onWritten = [=] (const boost::system::error_code & ec,
+                              size_t) {
+            if (onWriteFinished) {
+                onWriteFinished();
+            }
+            if (action == NEXT_CLOSE || action == NEXT_RECYCLE) {
+                requestClose();
+            }
+        };
+        requestWrite(std::move(buffers), onWritten);
+    }
+    else {
+        if (action == NEXT_CLOSE || action == NEXT_RECYCLE) {
+            requestClose();
+        }
+    }
+}
+
+/* Bodies smaller than this are copied after the header, which is cheaper
+   than a write with more than one buffer. */
+static constexpr size_t MIN_SCATTER_BODY_SIZE = 16384;
 
+/* Format the status line and the headers of the response, including the
+   blank line that ends them, into responseStr. */
+static void
+appendResponseHeader(string & responseStr, const HttpResponse & response,
+                     size_t bodyLength)
+{
     responseStr.append("HTTP/1.1 ");
     responseStr.append(to_string(response.responseCode));
     responseStr.append(" ");
@@ -182,7 +244,7 @@ putResponseOnWire(const HttpResponse & response,
 
     if (response.sendBody) {
         responseStr.append("Content-Length: ");
-        responseStr.append(to_string(response.body.length()));
+        responseStr.append(to_string(bodyLength));
         responseStr.append("\r\n");
         responseStr.append("Connection: Keep-Alive\r\n");
     }
@@ -195,9 +257,87 @@ putResponseOnWire(const HttpResponse & response,
     }
 
     responseStr.append("\r\n");
+}
+
+void
+HttpLegacySocketHandler::
+putResponseOnWire(const HttpResponse & response,
+                  std::function<void ()> onSendFinished,
+                  NextAction next)
+{
+    string responseStr;
+    responseStr.reserve(16384 + response.body.length());
+
+    appendResponseHeader(responseStr, response, response.body.length());
     responseStr.append(response.body);
 
-    send(std::move(responseStr), std::move(next), std::move(onSendFinished));
+    if (response.sendBody && next == NEXT_CONTINUE) {
+        auto onSent = [this, onSendFinished] () {
+            if (onSendFinished) {
+                onSendFinished();
+            }
+            onResponseSent();
+        };
+        send(std::move(responseStr), next, std::move(onSent));
+    }
+    else {
+        send(std::move(responseStr), next, std::move(onSendFinished));
+    }
+}
+
+void
+HttpLegacySocketHandler::
+putResponseOnWire(HttpResponse && response,
+                  std::function<void ()> onSendFinished,
+                  NextAction next)
+{
+    if (response.body.length() < MIN_SCATTER_BODY_SIZE) {
+        const HttpResponse & constResponse = response;
+        putResponseOnWire(constResponse, std::move(onSendFinished), next);
+        return;
+    }
+
+    vector<WriteBuffer> body;
+    body.emplace_back(std::move(response.body));
+    putResponseOnWire(response, std::move(body),
+                      std::move(onSendFinished), next);
+}
+
+void
+HttpLegacySocketHandler::
+putResponseOnWire(const HttpResponse & response,
+                  vector<WriteBuffer> body,
+                  std::function<void ()> onSendFinished,
+                  NextAction next)
+{
+    size_t bodyLength = 0;
+    for (auto & b: body) {
+        bodyLength += b.size;
+    }
+
+    string header;
+    header.reserve(1024);
+    appendResponseHeader(header, response, bodyLength);
+
+    vector<WriteBuffer> buffers;
+    buffers.reserve(body.size() + 1);
+    buffers.emplace_back(std::move(header));
+    for (auto & b: body) {
+        buffers.emplace_back(std::move(b));
+    }
+
+    if (response.sendBody && next == NEXT_CONTINUE) {
+        auto onSent = [this, onSendFinished] () {
+            if (onSendFinished) {
+                onSendFinished();
+            }
+            onResponseSent();
+        };
+        send(std::move(buffers), next, std::move(onSent));
+    }
+    else {
+        send(std::move(buffers), next, std::move(onSendFinished));
+    }
 }
 
 void
@@ -264,12 +404,72 @@ void
 HttpLegacySocketHandler::
 onDone(bool requireClose)
 {
-    HttpHeader header;
-    header.parse(headerPayload);
-    handleHttpPayload(header, bodyPayload);
+    bodyStarted_ = false;
+
+    {
+        std::unique_lock<std::mutex> guard(requestsMutex_);
+        if (responsePending_) {
+            // Pipelined request; it waits for the responses to the ones
+            // before it, and parsing carries on with recycled buffers
+            QueuedRequest request;
+            if (!spareRequests_.empty()) {
+                request = std::move(spareRequests_.back());
+                spareRequests_.pop_back();
+            }
+            request.header.swap(headerPayload);
+            request.payload.swap(bodyPayload);
+            queuedRequests_.emplace_back(std::move(request));
+            if (queuedRequests_.size() >= MAX_QUEUED_REQUESTS) {
+                pauseReceiving();
+            }
+            return;
+        }
+        responsePending_ = true;
+    }
+
+    dispatchRequest(headerPayload, bodyPayload);
     headerPayload.clear();
     bodyPayload.clear();
-    bodyStarted_ = false;
+}
+
+void
+HttpLegacySocketHandler::
+dispatchRequest(const std::string & headerStr, const std::string & payload)
+{
+    HttpHeader header;
+    header.parse(headerStr);
+    handleHttpPayload(header, payload);
+}
+
+void
+HttpLegacySocketHandler::
+onResponseSent()
+{
+    QueuedRequest request;
+    {
+        std::unique_lock<std::mutex> guard(requestsMutex_);
+        if (queuedRequests_.empty()) {
+            responsePending_ = false;
+            return;
+        }
+        request = std::move(queuedRequests_.front());
+        queuedRequests_.pop_front();
+    }
+
+    resumeReceiving();
+
+    try {
+        dispatchRequest(request.header, request.payload);
+    }
+    catch (const MLDB::Exception & exc) {
+        requestClose();
+        return;
+    }
+
+    request.header.clear();
+    request.payload.clear();
+    std::unique_lock<std::mutex> guard(requestsMutex_);
+    spareRequests_.emplace_back(std::move(request));
 }
 
 } // namespace MLDB
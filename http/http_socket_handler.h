@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <deque>
+#include <mutex>
 #include "mldb/ext/jsoncpp/value.h"
 #include "mldb/http/http_header.h"
 #include "mldb/http/http_parsers.h"
@@ -45,6 +47,13 @@ struct HttpSocketHandler : public TcpSocketHandler {
     /* Callback used to report the end of a response. */
     virtual void onDone(bool requireClose) = 0;
 
+protected:
+    /* Stop reading from the socket once the data already received has been
+       parsed, until resumeReceiving() is called. Used to stop clients from
+       pipelining more requests than we are willing to queue. */
+    void pauseReceiving();
+    void resumeReceiving();
+
 private:
     /* TcpSocketHandler interface */
     virtual void bootstrap();
@@ -53,6 +62,10 @@ private:
                                 size_t bufferSize);
 
     HttpRequestParser parser_;
+
+    std::mutex receiveMutex_;
+    bool receivePaused_;
+    bool receiveStalled_;   // a receive was held back while paused
 };
 
 
@@ -121,10 +134,33 @@ struct HttpLegacySocketHandler : public HttpSocketHandler {
                            std::function<void ()> onSendFinished
                            = std::function<void ()>(),
                            NextAction next = NEXT_CONTINUE);
+
+    /* Same, but the body is taken over and written after the header
+       without being copied. */
+    void putResponseOnWire(HttpResponse && response,
+                           std::function<void ()> onSendFinished
+                           = std::function<void ()>(),
+                           NextAction next = NEXT_CONTINUE);
+
+    /* Send a response whose body is made of the given buffers, which are
+       written after the header without being copied or joined.  The body
+       of the response itself is ignored; the content length is the total
+       size of the buffers. */
+    void putResponseOnWire(const HttpResponse & response,
+                           std::vector<WriteBuffer> body,
+                           std::function<void ()> onSendFinished
+                           = std::function<void ()>(),
+                           NextAction next = NEXT_CONTINUE);
+
     void send(std::string str,
               NextAction action = NEXT_CONTINUE,
               OnWriteFinished onWriteFinished = nullptr);
 
+    /* Send the given buffers with a single scatter-gather write. */
+    void send(std::vector<WriteBuffer> buffers,
+              NextAction action = NEXT_CONTINUE,
+              OnWriteFinished onWriteFinished = nullptr);
+
 protected:
     /* Overridable method returning whether the given request should be
        accepted for processing or not. The default implementation returns
@@ -143,10 +179,33 @@ private:
 
     void handleExpect100Continue();
 
+    /* Parse the header of a request and pass it to handleHttpPayload. */
+    void dispatchRequest(const std::string & header,
+                         const std::string & payload);
+
+    /* Called once a complete response has been written, to dispatch the
+       next pipelined request, if any. */
+    void onResponseSent();
+
+    /* Requests that were pipelined behind one whose response hasn't been
+       sent yet. They are dispatched in order as the responses go out. */
+    struct QueuedRequest {
+        std::string header;
+        std::string payload;
+    };
+
+    /* Number of pipelined requests after which we stop reading. */
+    static constexpr size_t MAX_QUEUED_REQUESTS = 32;
+
     std::string headerPayload;
     std::string bodyPayload;
     bool bodyStarted_;
 
+    std::mutex requestsMutex_;
+    bool responsePending_;
+    std::deque<QueuedRequest> queuedRequests_;
+    std::vector<QueuedRequest> spareRequests_;  // buffers to reuse
+
     std::string writeData_;
 };
 
@@ -0,0 +1,269 @@
+/* http_batch_fetch_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test for fetching batches of URLs concurrently.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <curl/curl.h>
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/http/http_batch_fetch.h"
+#include "mldb/base/exc_assert.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+/** Minimal keep-alive HTTP server.  Answers "/missing" with a 404,
+    "/flaky" with a 503 the first two times and anything else with the
+    path itself, after a delay.
+*/
+struct TestServer {
+    TestServer(double delay = 0.0)
+        : delay(delay)
+    {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        ExcAssertNotEqual(fd, -1);
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ExcAssertEqual(::bind(fd, (sockaddr *)&addr, sizeof(addr)), 0);
+        ExcAssertEqual(listen(fd, 64), 0);
+
+        socklen_t len = sizeof(addr);
+        getsockname(fd, (sockaddr *)&addr, &len);
+        uri = "http://127.0.0.1:" + to_string(ntohs(addr.sin_port));
+
+        acceptThread = std::thread([this] () { runAccept(); });
+    }
+
+    ~TestServer()
+    {
+        ::shutdown(fd, SHUT_RDWR);
+        acceptThread.join();
+        ::close(fd);
+
+        // Connections kept open by the pool would otherwise block forever
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            for (int conn: connections)
+                ::shutdown(conn, SHUT_RDWR);
+        }
+        for (auto & t: handlers)
+            t.join();
+    }
+
+    void runAccept()
+    {
+        for (;;) {
+            int conn = accept(fd, nullptr, nullptr);
+            if (conn == -1)
+                return;
+            std::unique_lock<std::mutex> guard(lock);
+            connections.push_back(conn);
+            handlers.emplace_back([this, conn] () { serve(conn); });
+        }
+    }
+
+    void serve(int conn)
+    {
+        std::string buf;
+        char data[4096];
+        for (;;) {
+            size_t end;
+            while ((end = buf.find("\r\n\r\n")) == std::string::npos) {
+                ssize_t n = recv(conn, data, sizeof(data), 0);
+                if (n <= 0) {
+                    ::close(conn);
+                    return;
+                }
+                buf.append(data, n);
+            }
+            size_t pathStart = buf.find(' ') + 1;
+            std::string path(buf, pathStart, buf.find(' ', pathStart) - pathStart);
+            buf.erase(0, end + 4);  // GET requests have no body
+
+            int nowActive = ++active;
+            int prevMax = maxActive;
+            while (nowActive > prevMax
+                   && !maxActive.compare_exchange_weak(prevMax, nowActive))
+                ;
+            std::this_thread::sleep_for(std::chrono::duration<double>(delay));
+            --active;
+
+            int times;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                times = ++requests[path];
+            }
+
+            std::string status = "200 OK", body = path;
+            if (path == "/missing")
+                status = "404 Not Found";
+            else if (path == "/flaky" && times <= 2)
+                status = "503 Service Unavailable";
+
+            std::string response
+                = "HTTP/1.1 " + status + "\r\nContent-Length: "
+                + to_string(body.size()) + "\r\n\r\n" + body;
+            send(conn, response.data(), response.size(), MSG_NOSIGNAL);
+        }
+    }
+
+    double delay;
+    int fd;
+    std::string uri;
+    std::atomic<int> active{0};
+    std::atomic<int> maxActive{0};
+
+    std::mutex lock;
+    std::map<std::string, int> requests;
+    std::vector<int> connections;
+    std::vector<std::thread> handlers;
+    std::thread acceptThread;
+};
+
+static std::vector<HttpBatchFetchResult>
+fetchAll(const std::vector<std::string> & urls,
+         const HttpBatchFetchOptions & options)
+{
+    std::vector<HttpBatchFetchResult> results(urls.size());
+    std::vector<int> calls(urls.size());
+    httpBatchFetch(urls, options,
+                   [&] (size_t index, HttpBatchFetchResult & result)
+                   {
+                       ++calls[index];
+                       results[index] = std::move(result);
+                   });
+    for (int c: calls)
+        BOOST_CHECK_EQUAL(c, 1);
+    return results;
+}
+
+BOOST_AUTO_TEST_CASE( test_max_in_flight )
+{
+    TestServer server(0.05);
+
+    std::vector<std::string> urls;
+    for (int i = 0;  i < 20;  ++i)
+        urls.push_back(server.uri + "/" + to_string(i));
+
+    HttpBatchFetchOptions options;
+    options.maxInFlight = 4;
+    auto results = fetchAll(urls, options);
+
+    for (int i = 0;  i < 20;  ++i) {
+        BOOST_CHECK_EQUAL(results[i].responseCode, 200);
+        BOOST_CHECK_EQUAL(results[i].body, "/" + to_string(i));
+        BOOST_CHECK_EQUAL(results[i].attempts, 1);
+    }
+
+    // Requests really were concurrent, but never more than allowed
+    BOOST_CHECK_GT(server.maxActive, 1);
+    BOOST_CHECK_LE(server.maxActive, 4);
+}
+
+BOOST_AUTO_TEST_CASE( test_max_in_flight_per_host )
+{
+    TestServer server1(0.05), server2(0.05);
+
+    std::vector<std::string> urls;
+    for (int i = 0;  i < 10;  ++i) {
+        urls.push_back(server1.uri + "/" + to_string(i));
+        urls.push_back(server2.uri + "/" + to_string(i));
+    }
+
+    HttpBatchFetchOptions options;
+    options.maxInFlight = 0;
+    options.maxInFlightPerHost = 2;
+    auto results = fetchAll(urls, options);
+
+    for (auto & r: results)
+        BOOST_CHECK_EQUAL(r.responseCode, 200);
+    BOOST_CHECK_LE(server1.maxActive, 2);
+    BOOST_CHECK_LE(server2.maxActive, 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_rate_limit )
+{
+    TestServer server;
+
+    std::vector<std::string> urls(10, server.uri + "/hello");
+
+    HttpBatchFetchOptions options;
+    options.maxRequestsPerSecondPerHost = 20;
+
+    Date before = Date::now();
+    auto results = fetchAll(urls, options);
+    double elapsed = Date::now().secondsSince(before);
+
+    for (auto & r: results)
+        BOOST_CHECK_EQUAL(r.responseCode, 200);
+
+    // Ten requests at 20 per second need nine intervals of 50ms
+    BOOST_CHECK_GE(elapsed, 0.44);
+}
+
+BOOST_AUTO_TEST_CASE( test_retries )
+{
+    TestServer server;
+
+    HttpBatchFetchOptions options;
+    options.maxRetries = 3;
+    options.retryBackoffSeconds = 0.01;
+    auto results = fetchAll({ server.uri + "/flaky", server.uri + "/missing" },
+                            options);
+
+    // Retried after each 503 until it succeeds
+    BOOST_CHECK_EQUAL(results[0].responseCode, 200);
+    BOOST_CHECK_EQUAL(results[0].attempts, 3);
+
+    // A 404 won't go away by trying again
+    BOOST_CHECK_EQUAL(results[1].responseCode, 404);
+    BOOST_CHECK_EQUAL(results[1].attempts, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_connection_errors )
+{
+    // Find a port that nothing is listening on
+    std::string uri;
+    {
+        TestServer server;
+        uri = server.uri;
+    }
+
+    HttpBatchFetchOptions options;
+    options.maxRetries = 1;
+    options.retryBackoffSeconds = 0.01;
+    auto results = fetchAll({ uri + "/nothing" }, options);
+
+    BOOST_CHECK_EQUAL(results[0].responseCode, 0);
+    BOOST_CHECK_EQUAL(results[0].errorCode, CURLE_COULDNT_CONNECT);
+    BOOST_CHECK_NE(results[0].errorMessage, "");
+    BOOST_CHECK_EQUAL(results[0].attempts, 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_empty_batch )
+{
+    httpBatchFetch({}, HttpBatchFetchOptions(),
+                   [] (size_t, HttpBatchFetchResult &)
+                   {
+                       BOOST_FAIL("called for an empty batch");
+                   });
+}
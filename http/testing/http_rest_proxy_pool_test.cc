@@ -0,0 +1,225 @@
+/* http_rest_proxy_pool_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test for the connection pool shared by HttpRestProxy instances.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <curl/curl.h>
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/http/http_rest_proxy.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/exception_handler.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+/** Minimal keep-alive HTTP server that answers every request with "ok" after
+    a delay, and counts the connections that it accepts.
+*/
+struct KeepAliveServer {
+    KeepAliveServer(double delay = 0.0)
+        : delay(delay)
+    {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        ExcAssertNotEqual(fd, -1);
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ExcAssertEqual(::bind(fd, (sockaddr *)&addr, sizeof(addr)), 0);
+        ExcAssertEqual(listen(fd, 64), 0);
+
+        socklen_t len = sizeof(addr);
+        getsockname(fd, (sockaddr *)&addr, &len);
+        uri = "http://127.0.0.1:" + to_string(ntohs(addr.sin_port));
+
+        acceptThread = std::thread([this] () { runAccept(); });
+    }
+
+    ~KeepAliveServer()
+    {
+        ::shutdown(fd, SHUT_RDWR);
+        acceptThread.join();
+        ::close(fd);
+
+        // Connections kept open by the pool would otherwise block forever
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            for (int conn: connections)
+                ::shutdown(conn, SHUT_RDWR);
+        }
+        for (auto & t: handlers)
+            t.join();
+    }
+
+    void runAccept()
+    {
+        for (;;) {
+            int conn = accept(fd, nullptr, nullptr);
+            if (conn == -1)
+                return;
+            ++accepted;
+            std::unique_lock<std::mutex> guard(lock);
+            connections.push_back(conn);
+            handlers.emplace_back([this, conn] () { serve(conn); });
+        }
+    }
+
+    void serve(int conn)
+    {
+        std::string buf;
+        char data[4096];
+        for (;;) {
+            size_t end;
+            while ((end = buf.find("\r\n\r\n")) == std::string::npos) {
+                ssize_t n = recv(conn, data, sizeof(data), 0);
+                if (n <= 0) {
+                    ::close(conn);
+                    return;
+                }
+                buf.append(data, n);
+            }
+            buf.erase(0, end + 4);  // GET requests have no body
+
+            int nowActive = ++active;
+            int prevMax = maxActive;
+            while (nowActive > prevMax
+                   && !maxActive.compare_exchange_weak(prevMax, nowActive))
+                ;
+            std::this_thread::sleep_for(std::chrono::duration<double>(delay));
+            --active;
+
+            std::string response
+                = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+            send(conn, response.data(), response.size(), MSG_NOSIGNAL);
+        }
+    }
+
+    double delay;
+    int fd;
+    std::string uri;
+    std::atomic<int> accepted{0};
+    std::atomic<int> active{0};
+    std::atomic<int> maxActive{0};
+
+    std::mutex lock;
+    std::vector<int> connections;
+    std::vector<std::thread> handlers;
+    std::thread acceptThread;
+};
+
+/// Restores the pool's options at the end of a test
+struct PoolConfigGuard {
+    PoolConfigGuard()
+        : saved(getHttpConnectionPoolConfig())
+    {
+    }
+
+    ~PoolConfigGuard()
+    {
+        setHttpConnectionPoolConfig(saved);
+    }
+
+    HttpConnectionPoolConfig saved;
+};
+
+BOOST_AUTO_TEST_CASE( test_connections_are_shared_between_proxies )
+{
+    KeepAliveServer server;
+    auto before = getHttpConnectionPoolStats();
+
+    for (int i = 0;  i < 10;  ++i) {
+        // A new proxy each time, like the fetcher and the http:// streams
+        HttpRestProxy proxy(server.uri);
+        auto response = proxy.get("/hello");
+        BOOST_REQUIRE_EQUAL(response.code(), 200);
+        BOOST_CHECK_EQUAL(response.body(), "ok");
+    }
+
+    auto after = getHttpConnectionPoolStats();
+    BOOST_CHECK_EQUAL(server.accepted, 1);
+    BOOST_CHECK_EQUAL(after.requests - before.requests, 10);
+    BOOST_CHECK_EQUAL(after.connectionsOpened - before.connectionsOpened, 1);
+    BOOST_CHECK_GE(after.idleHandles, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_max_connections_per_host )
+{
+    PoolConfigGuard guard;
+    auto config = getHttpConnectionPoolConfig();
+    config.maxConnectionsPerHost = 2;
+    setHttpConnectionPoolConfig(config);
+
+    KeepAliveServer server(0.02);
+    auto before = getHttpConnectionPoolStats();
+
+    std::vector<std::thread> threads;
+    std::atomic<int> succeeded(0);
+    for (int i = 0;  i < 8;  ++i) {
+        threads.emplace_back([&] ()
+            {
+                HttpRestProxy proxy(server.uri);
+                for (int j = 0;  j < 3;  ++j) {
+                    if (proxy.get("/hello").code() == 200)
+                        ++succeeded;
+                }
+            });
+    }
+    for (auto & t: threads)
+        t.join();
+
+    auto after = getHttpConnectionPoolStats();
+    BOOST_CHECK_EQUAL(succeeded, 24);
+    BOOST_CHECK_LE(server.maxActive, 2);
+    BOOST_CHECK_LE(server.accepted, 2);
+    BOOST_CHECK_GT(after.waits - before.waits, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_wait_for_host_times_out )
+{
+    PoolConfigGuard guard;
+    auto config = getHttpConnectionPoolConfig();
+    config.maxConnectionsPerHost = 1;
+    setHttpConnectionPoolConfig(config);
+
+    KeepAliveServer server(0.5);
+
+    std::thread slow([&] ()
+        {
+            HttpRestProxy proxy(server.uri);
+            proxy.get("/slow");
+        });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    HttpRestProxy proxy(server.uri);
+    auto response = proxy.get("/fast", {}, {}, 0.05 /* timeout */,
+                              false /* exceptions */);
+    BOOST_CHECK_EQUAL(response.errorCode(), CURLE_OPERATION_TIMEDOUT);
+
+    slow.join();
+}
+
+BOOST_AUTO_TEST_CASE( test_invalid_config )
+{
+    MLDB_TRACE_EXCEPTIONS(false);
+    HttpConnectionPoolConfig config;
+    config.maxConnectionsPerHost = -1;
+    BOOST_CHECK_THROW(setHttpConnectionPoolConfig(config), MLDB::Exception);
+}
@@ -11,6 +11,7 @@
 
 #include <iostream>
 #include <string>
+#include <thread>
 #include <boost/test/unit_test.hpp>
 #include <boost/asio.hpp>
 #include "base/exc_assert.h"
@@ -214,3 +215,77 @@ BOOST_AUTO_TEST_CASE( tcp_acceptor_http_100_continue )
 
     pool.shutdown();
 }
+
+
+/* Handler that answers each request from another thread after a delay that
+   is shorter for the later requests, so that the responses to pipelined
+   requests would come out of order if they weren't serialized. */
+struct DelayedHandler : public HttpLegacySocketHandler {
+    DelayedHandler(TcpSocket && socket)
+        : HttpLegacySocketHandler(std::move(socket))
+    {
+    }
+
+    virtual void handleHttpPayload(const HttpHeader & header,
+                                   const std::string & payload)
+    {
+        int delayMs = 300 - 100 * std::stoi(header.resource.substr(1));
+        string body = header.resource;
+        std::thread([=] () {
+                std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+                putResponseOnWire(HttpResponse(200, "text/plain", body));
+            }).detach();
+    }
+};
+
+/* Test that pipelined requests get their responses in order */
+BOOST_AUTO_TEST_CASE( tcp_acceptor_http_pipelining )
+{
+    EventLoop loop;
+    AsioThreadPool pool(loop);
+
+    auto onNewConnection = [&] (TcpSocket && socket) {
+        return std::make_shared<DelayedHandler>(std::move(socket));
+    };
+
+    TcpAcceptor acceptor(loop, onNewConnection);
+    acceptor.listen(0, "localhost");
+
+    auto address = asio::ip::address::from_string("127.0.0.1");
+    asio::ip::tcp::endpoint serverEndpoint(address,
+                                           acceptor.effectiveTCPv4Port());
+
+    {
+        auto socket = asio::ip::tcp::socket(loop.impl().ioService());
+        socket.connect(serverEndpoint);
+
+        string requests;
+        for (int i = 0;  i < 3;  ++i) {
+            requests += ("GET /" + to_string(i) + " HTTP/1.1\r\n"
+                         "Host: *\r\n"
+                         "\r\n");
+        }
+        socket.send(asio::buffer(requests.c_str(), requests.size()));
+
+        string expected;
+        for (int i = 0;  i < 3;  ++i) {
+            expected += ("HTTP/1.1 200 OK\r\n"
+                         "Content-Type: text/plain\r\n"
+                         "Content-Length: 2\r\n"
+                         "Connection: Keep-Alive\r\n"
+                         "\r\n"
+                         "/" + to_string(i));
+        }
+
+        string received;
+        while (received.size() < expected.size()) {
+            char recvBuffer[1024];
+            size_t nBytes = socket.receive(asio::buffer(recvBuffer,
+                                                        sizeof(recvBuffer)));
+            received.append(recvBuffer, nBytes);
+        }
+        BOOST_CHECK_EQUAL(received, expected);
+    }
+
+    pool.shutdown();
+}
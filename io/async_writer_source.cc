@@ -12,6 +12,7 @@
 #include <poll.h>
 #include <unistd.h>
 
+#include "mldb/arch/wakeup_fd.h"
 #include "mldb/base/exc_assert.h"
 
 #include "async_writer_source.h"
@@ -28,9 +29,74 @@ inline bool isFileFlagSet(int fd, int flag)
     return ((oldFlags & flag) == flag);
 }
 
+/* user_data of the operations submitted to the ring */
+enum UringOp : uint64_t {
+    URING_READ = 1,
+    URING_WRITE = 2,
+    URING_POLL_IN = 3,
+    URING_POLL_OUT = 4,
+    URING_HANGUP = 5,
+    URING_CANCEL = 6
+};
+
+/* maximum number of queued messages sent by a single vectored write */
+constexpr size_t URING_MAX_BATCH = 64;
+
 } // file scope
 
 
+/****************************************************************************/
+/* URING STATE                                                              */
+/****************************************************************************/
+
+struct AsyncWriterSource::UringState {
+    UringState(size_t readBufferSize)
+        : ring(16), completions(EFD_NONBLOCK | EFD_CLOEXEC),
+          readBuffer(readBufferSize), fixedBuffer(false),
+          inFlight(0), writing(false), closeRequested(false)
+    {
+        ring.registerEventFd(completions.fd());
+        if (readBufferSize > 0) {
+            /* Registering may fail where it counts against RLIMIT_MEMLOCK,
+               in which case plain reads into the same buffer are used. */
+            try {
+                ::iovec iov{readBuffer.data(), readBuffer.size()};
+                ring.registerBuffers(&iov, 1);
+                fixedBuffer = true;
+            }
+            catch (const std::exception & exc) {
+            }
+        }
+    }
+
+    ::io_uring_sqe * getSqe()
+    {
+        ::io_uring_sqe * sqe = ring.getSqe();
+        if (!sqe) {
+            ring.submit();
+            sqe = ring.getSqe();
+            ExcAssert(sqe != nullptr);
+        }
+        inFlight++;
+        return sqe;
+    }
+
+    IoUring ring;
+    WakeupFd completions;    /* signaled by the ring for each completion */
+    std::vector<char> readBuffer;
+    bool fixedBuffer;        /* whether readBuffer is registered */
+
+    int inFlight;            /* operations not completed yet */
+    bool writing;            /* whether the write of "writes" is in flight */
+    bool closeRequested;     /* whether requestClose's marker was popped */
+
+    /* messages sent by the current write, the first one possibly partially
+       sent already */
+    std::vector<AsyncWrite> writes;
+    std::vector<::iovec> iovecs;
+};
+
+
 AsyncWriterSource::
 AsyncWriterSource(const OnClosed & onClosed,
                   const OnReceivedData & onReceivedData,
@@ -78,12 +144,18 @@ setFd(int newFd)
 
     addFd(queue_.selectFd(), true, false);
 
-    auto handleFdEventCb = [&] (const ::epoll_event & event) {
-        this->handleFdEvent(event);
-    };
-    registerFdCallback(newFd, handleFdEventCb);
-    addFd(newFd, readBufferSize_ > 0, true);
-    fd_ = newFd;
+    if (getIoBackend() == IoBackend::IO_URING) {
+        fd_ = newFd;
+        startUring();
+    }
+    else {
+        auto handleFdEventCb = [&] (const ::epoll_event & event) {
+            this->handleFdEvent(event);
+        };
+        registerFdCallback(newFd, handleFdEventCb);
+        addFd(newFd, readBufferSize_ > 0, true);
+        fd_ = newFd;
+    }
     closing_ = false;
     enableQueue();
 }
@@ -224,7 +296,13 @@ void
 AsyncWriterSource::
 handleQueueNotification()
 {
-    if (fd_ != -1) {
+    if (fd_ != -1 && uring_) {
+        flushUring();
+        if (uring_) {
+            uring_->ring.submit();
+        }
+    }
+    else if (fd_ != -1) {
         flush();
         if (fd_ != -1 && !writeReady_) {
             modifyFd(fd_, readBufferSize_ > 0, true);
@@ -342,13 +420,21 @@ handleClosing(bool fromPeer, bool delayedUnregistration)
     if (fd_ != -1) {
         disableQueue();
         removeFd(queue_.selectFd());
-        unregisterFdCallback(fd_, delayedUnregistration);
-        removeFd(fd_);
+        vector<string> lostMessages;
+        if (uring_) {
+            lostMessages = stopUring(delayedUnregistration);
+        }
+        else {
+            unregisterFdCallback(fd_, delayedUnregistration);
+            removeFd(fd_);
+        }
         ::close(fd_);
         fd_ = -1;
         writeReady_ = false;
 
-        vector<string> lostMessages = emptyMessageQueue();
+        for (auto & message: emptyMessageQueue()) {
+            lostMessages.emplace_back(move(message));
+        }
         onClosed(fromPeer, lostMessages);
     }
 }
@@ -366,3 +452,283 @@ emptyMessageQueue()
 
     return messages;
 }
+
+/* io_uring backend */
+
+void
+AsyncWriterSource::
+startUring()
+{
+    uring_.reset(new UringState(readBufferSize_));
+
+    auto handleUringEventsCb = [&] (const ::epoll_event & event) {
+        this->handleUringEvents();
+    };
+    registerFdCallback(uring_->completions.fd(), handleUringEventsCb);
+    addFd(uring_->completions.fd(), true, false);
+
+    if (readBufferSize_ > 0) {
+        submitUringRead();
+    }
+    else {
+        /* Without reads, a hangup is only noticed by polling for it; a
+           mask of 0 still reports POLLERR and POLLHUP. */
+        ::io_uring_sqe * sqe = uring_->getSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd_;
+        sqe->poll_events = 0;
+        sqe->user_data = URING_HANGUP;
+    }
+    uring_->ring.submit();
+}
+
+void
+AsyncWriterSource::
+submitUringRead()
+{
+    UringState & uring = *uring_;
+    ::io_uring_sqe * sqe = uring.getSqe();
+    if (uring.fixedBuffer) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->buf_index = 0;
+    }
+    else {
+        sqe->opcode = IORING_OP_READ;
+    }
+    sqe->fd = fd_;
+    sqe->addr = (uintptr_t) uring.readBuffer.data();
+    sqe->len = uring.readBuffer.size();
+    sqe->off = (uint64_t) -1;
+    sqe->user_data = URING_READ;
+}
+
+void
+AsyncWriterSource::
+submitUringPoll(bool forWriting)
+{
+    /* Older kernels fail operations on non-blocking descriptors with EAGAIN
+       instead of waiting for them to become ready, so we wait for them. */
+    ::io_uring_sqe * sqe = uring_->getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd_;
+    sqe->poll_events = forWriting ? POLLOUT : POLLIN;
+    sqe->user_data = forWriting ? URING_POLL_OUT : URING_POLL_IN;
+}
+
+void
+AsyncWriterSource::
+flushUring()
+{
+    UringState & uring = *uring_;
+    if (uring.writing || fd_ == -1) {
+        return;
+    }
+
+    if (uring.writes.size() < URING_MAX_BATCH && !uring.closeRequested) {
+        auto writes = queue_.pop_front(URING_MAX_BATCH - uring.writes.size());
+        for (auto & write: writes) {
+            if (write.message.empty()) {
+                ExcAssert(closing_);
+                uring.closeRequested = true;
+                break;
+            }
+            uring.writes.emplace_back(move(write));
+        }
+    }
+
+    if (uring.writes.empty()) {
+        if (uring.closeRequested) {
+            handleClosing(false, true);
+        }
+        return;
+    }
+
+    uring.iovecs.resize(uring.writes.size());
+    for (size_t i = 0; i < uring.writes.size(); i++) {
+        AsyncWrite & write = uring.writes[i];
+        uring.iovecs[i].iov_base = (void *) (write.message.data() + write.sent);
+        uring.iovecs[i].iov_len = write.message.size() - write.sent;
+    }
+
+    ::io_uring_sqe * sqe = uring.getSqe();
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd_;
+    sqe->addr = (uintptr_t) uring.iovecs.data();
+    sqe->len = uring.iovecs.size();
+    sqe->off = (uint64_t) -1;
+    sqe->user_data = URING_WRITE;
+    uring.writing = true;
+}
+
+void
+AsyncWriterSource::
+handleUringEvents()
+{
+    if (!uring_) {
+        return;
+    }
+    while (uring_->completions.tryRead());
+
+    /* Completion handlers may close the source, which destroys the ring */
+    ::io_uring_cqe cqe;
+    while (uring_ && uring_->ring.popCompletion(cqe)) {
+        handleUringCompletion(cqe);
+    }
+    if (uring_) {
+        uring_->ring.submit();
+    }
+}
+
+void
+AsyncWriterSource::
+handleUringCompletion(const ::io_uring_cqe & cqe)
+{
+    uring_->inFlight--;
+
+    switch (cqe.user_data) {
+    case URING_READ:
+        handleUringRead(cqe.res);
+        break;
+    case URING_WRITE:
+        handleUringWrite(cqe.res);
+        break;
+    case URING_POLL_IN:
+        if (fd_ != -1) {
+            submitUringRead();
+        }
+        break;
+    case URING_POLL_OUT:
+        if (fd_ != -1) {
+            flushUring();
+        }
+        break;
+    case URING_HANGUP:
+        if (fd_ != -1 && cqe.res > 0 && (cqe.res & (POLLHUP | POLLERR))) {
+            handleClosing(true, true);
+        }
+        break;
+    default:
+        throw MLDB::Exception("unexpected io_uring completion: %llu",
+                              (unsigned long long) cqe.user_data);
+    }
+}
+
+void
+AsyncWriterSource::
+handleUringRead(int res)
+{
+    if (res > 0) {
+        bytesReceived_ += res;
+        onReceivedData(uring_->readBuffer.data(), res);
+        if (uring_ && fd_ != -1) {
+            submitUringRead();
+        }
+    }
+    else if (res == 0) {
+        /* eof, ignored when closing as with the epoll backend */
+        if (!closing_) {
+            handleClosing(true, true);
+        }
+    }
+    else if (res == -EAGAIN) {
+        submitUringPoll(false);
+    }
+    else if (res == -EBADF || res == -EINVAL || res == -ECANCELED) {
+        /* closed by the remote process or by us */
+    }
+    else {
+        throw MLDB::Exception(-res, "read");
+    }
+}
+
+void
+AsyncWriterSource::
+handleUringWrite(int res)
+{
+    UringState & uring = *uring_;
+    uring.writing = false;
+
+    if (res == -EAGAIN) {
+        submitUringPoll(true);
+        return;
+    }
+    if (res < 0) {
+        int error = -res;
+        AsyncWrite failed = move(uring.writes.front());
+        uring.writes.erase(uring.writes.begin());
+        handleWriteResult(error, move(failed));
+        if (error == EPIPE || error == EBADF) {
+            handleClosing(true, true);
+            return;
+        }
+        /* same as with the epoll backend */
+        throw MLDB::Exception(error, "unhandled write error");
+    }
+
+    bytesSent_ += res;
+    size_t remaining(res);
+    size_t numDone(0);
+    for (AsyncWrite & write: uring.writes) {
+        size_t left = write.message.size() - write.sent;
+        if (remaining < left) {
+            write.sent += remaining;
+            break;
+        }
+        write.sent += left;
+        remaining -= left;
+        numDone++;
+    }
+
+    /* Callbacks may close the source, so they are invoked last */
+    vector<AsyncWrite> done(make_move_iterator(uring.writes.begin()),
+                            make_move_iterator(uring.writes.begin()
+                                               + numDone));
+    uring.writes.erase(uring.writes.begin(), uring.writes.begin() + numDone);
+    for (AsyncWrite & write: done) {
+        msgsSent_++;
+        handleWriteResult(0, move(write));
+    }
+
+    if (uring_) {
+        flushUring();
+    }
+}
+
+vector<string>
+AsyncWriterSource::
+stopUring(bool delayedUnregistration)
+{
+    UringState & uring = *uring_;
+
+    /* The operations in flight refer to our buffers, so they must be
+       cancelled and completed before the ring is destroyed. */
+    if (uring.inFlight > 0) {
+        for (uint64_t op: { URING_READ, URING_WRITE, URING_POLL_IN,
+                            URING_POLL_OUT, URING_HANGUP }) {
+            ::io_uring_sqe * sqe = uring.getSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = op;
+            sqe->user_data = URING_CANCEL;
+        }
+        ::io_uring_cqe cqe;
+        while (uring.inFlight > 0) {
+            uring.ring.submit(1);
+            while (uring.ring.popCompletion(cqe)) {
+                uring.inFlight--;
+            }
+        }
+    }
+
+    int completionsFd = uring.completions.fd();
+    unregisterFdCallback(completionsFd, delayedUnregistration);
+    removeFd(completionsFd);
+
+    vector<string> unsent;
+    for (auto & write: uring.writes) {
+        unsent.emplace_back(move(write.message));
+    }
+    uring_.reset();
+
+    return unsent;
+}
@@ -10,10 +10,12 @@
 #pragma once
 
 #include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "mldb/io/epoll_loop.h"
+#include "mldb/io/io_uring.h"
 #include "mldb/io/typed_message_channel.h"
 
 
@@ -49,7 +51,14 @@ struct AsyncWriteResult {
 /****************************************************************************/
 
 /* A base class enabling the asynchronous and buffered writing of data to a
- * file descriptor. */
+ * file descriptor.
+ *
+ * With the epoll backend, the file descriptor is registered in the epoll
+ * loop and read(2)/write(2) are called when it is ready. With the io_uring
+ * backend, reads into a registered buffer and vectored writes of all the
+ * queued messages are submitted to a ring owned by the source, and only
+ * the ring's completion eventfd is registered in the epoll loop. The
+ * backend is chosen from getIoBackend() when the file descriptor is set. */
 
 struct AsyncWriterSource : public EpollLoop
 {
@@ -116,6 +125,10 @@ struct AsyncWriterSource : public EpollLoop
     size_t msgsSent() const
     { return msgsSent_; }
 
+    /* backend used for the current file descriptor */
+    IoBackend backend() const
+    { return uring_ ? IoBackend::IO_URING : IoBackend::EPOLL; }
+
 protected:
     /* set the "main" file descriptor, for which epoll events are monitored
      * and the onWriteResult, onReceivedData and onClosed callbacks are
@@ -183,6 +196,18 @@ private:
     /* wakeup operations */
     void handleQueueNotification();
 
+    /* io_uring operations */
+    struct UringState;
+    void startUring();
+    void submitUringRead();
+    void submitUringPoll(bool forWriting);
+    void flushUring();
+    void handleUringEvents();
+    void handleUringCompletion(const ::io_uring_cqe & cqe);
+    void handleUringRead(int res);
+    void handleUringWrite(int res);
+    std::vector<std::string> stopUring(bool delayedUnregistration);
+
     int fd_;
     std::atomic<bool> closing_;
     size_t readBufferSize_;
@@ -199,6 +224,8 @@ private:
     OnClosed onClosed_;
     OnWriteResult onWriteResult_;
     OnReceivedData onReceivedData_;
+
+    std::unique_ptr<UringState> uring_;
 };
 
 }
@@ -0,0 +1,293 @@
+// This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+/* io_uring.cc
+   Copyright (c) 2016 mldb.ai inc.  All rights reserved.
+
+   A minimal wrapper around a Linux io_uring instance.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <mutex>
+
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include "io_uring.h"
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+/* Features without which we don't use io_uring: a single mapping for both
+   rings, no dropped completions and operations on sockets and pipes that
+   wait for readiness inside the kernel. These are all present from 5.7. */
+constexpr unsigned REQUIRED_FEATURES
+    = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_FAST_POLL;
+
+int ioUringSetup(unsigned entries, ::io_uring_params * params)
+{
+    return ::syscall(__NR_io_uring_setup, entries, params);
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete,
+                 unsigned flags)
+{
+    return ::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags,
+                     nullptr, 0);
+}
+
+int ioUringRegister(int fd, unsigned opcode, const void * arg,
+                    unsigned nrArgs)
+{
+    return ::syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+template<typename T>
+T * ringField(void * ring, unsigned offset)
+{
+    return reinterpret_cast<T *>(static_cast<char *>(ring) + offset);
+}
+
+bool detectIoUring()
+{
+    ::io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+    int fd = ioUringSetup(2, &params);
+    if (fd == -1) {
+        /* ENOSYS: old kernel; EPERM: disabled by sysctl or seccomp */
+        return false;
+    }
+    ::close(fd);
+    return (params.features & REQUIRED_FEATURES) == REQUIRED_FEATURES;
+}
+
+IoBackend parseIoBackend(const char * value)
+{
+    string name(value);
+    if (name == "epoll") {
+        return IoBackend::EPOLL;
+    }
+    else if (name == "io_uring") {
+        return IoBackend::IO_URING;
+    }
+    throw MLDB::Exception("MLDB_IO_BACKEND must be 'epoll' or 'io_uring', "
+                          "not '" + name + "'");
+}
+
+std::mutex backendLock;
+bool backendSet(false);
+IoBackend backend(IoBackend::EPOLL);
+
+} // file scope
+
+
+/****************************************************************************/
+/* IO BACKEND                                                               */
+/****************************************************************************/
+
+namespace MLDB {
+
+IoBackend
+getIoBackend()
+{
+    std::unique_lock<std::mutex> guard(backendLock);
+    if (!backendSet) {
+        const char * value = ::getenv("MLDB_IO_BACKEND");
+        if (value && *value) {
+            backend = parseIoBackend(value);
+        }
+        if (backend == IoBackend::IO_URING && !IoUring::available()) {
+            ::fprintf(stderr, "MLDB_IO_BACKEND: io_uring is not available, "
+                      "using epoll\n");
+            backend = IoBackend::EPOLL;
+        }
+        backendSet = true;
+    }
+    return backend;
+}
+
+void
+setIoBackend(IoBackend newBackend)
+{
+    if (newBackend == IoBackend::IO_URING && !IoUring::available()) {
+        throw MLDB::Exception("io_uring is not available");
+    }
+    std::unique_lock<std::mutex> guard(backendLock);
+    backend = newBackend;
+    backendSet = true;
+}
+
+std::string
+to_string(IoBackend backend)
+{
+    switch (backend) {
+    case IoBackend::EPOLL: return "epoll";
+    case IoBackend::IO_URING: return "io_uring";
+    }
+    throw MLDB::Exception("unknown IoBackend");
+}
+
+} // namespace MLDB
+
+
+/****************************************************************************/
+/* IO URING                                                                 */
+/****************************************************************************/
+
+IoUring::
+IoUring(unsigned entries)
+    : fd_(-1), sqRing_(MAP_FAILED), sqes_((::io_uring_sqe *) MAP_FAILED),
+      sqeHead_(0), sqeTail_(0)
+{
+    ::io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+    fd_ = ioUringSetup(entries, &params);
+    if (fd_ == -1) {
+        throw MLDB::Exception(errno, "io_uring_setup");
+    }
+    if ((params.features & REQUIRED_FEATURES) != REQUIRED_FEATURES) {
+        ::close(fd_);
+        throw MLDB::Exception("io_uring lacks required features");
+    }
+
+    /* With IORING_FEAT_SINGLE_MMAP, both rings share one mapping */
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = (params.cq_off.cqes
+                   + params.cq_entries * sizeof(::io_uring_cqe));
+    sqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        int error = errno;
+        ::close(fd_);
+        throw MLDB::Exception(error, "mmap io_uring rings");
+    }
+    cqRing_ = sqRing_;
+
+    sqesSize_ = params.sq_entries * sizeof(::io_uring_sqe);
+    sqes_ = (::io_uring_sqe *) ::mmap(nullptr, sqesSize_,
+                                      PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_POPULATE,
+                                      fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+        int error = errno;
+        ::munmap(sqRing_, sqRingSize_);
+        ::close(fd_);
+        throw MLDB::Exception(error, "mmap io_uring entries");
+    }
+
+    sqMask_ = *ringField<unsigned>(sqRing_, params.sq_off.ring_mask);
+    sqEntries_ = *ringField<unsigned>(sqRing_, params.sq_off.ring_entries);
+    sqKTail_ = ringField<std::atomic<unsigned> >(sqRing_, params.sq_off.tail);
+    sqArray_ = ringField<unsigned>(sqRing_, params.sq_off.array);
+    sqeHead_ = sqeTail_ = sqKTail_->load(std::memory_order_relaxed);
+
+    cqMask_ = *ringField<unsigned>(cqRing_, params.cq_off.ring_mask);
+    cqKHead_ = ringField<std::atomic<unsigned> >(cqRing_, params.cq_off.head);
+    cqKTail_ = ringField<std::atomic<unsigned> >(cqRing_, params.cq_off.tail);
+    cqes_ = ringField<::io_uring_cqe>(cqRing_, params.cq_off.cqes);
+}
+
+IoUring::
+~IoUring()
+{
+    ::munmap(sqes_, sqesSize_);
+    ::munmap(sqRing_, sqRingSize_);
+    ::close(fd_);
+}
+
+bool
+IoUring::
+available()
+{
+    static const bool result = detectIoUring();
+    return result;
+}
+
+::io_uring_sqe *
+IoUring::
+getSqe()
+{
+    /* Without SQPOLL, the kernel consumes every entry during io_uring_enter,
+       so the entries in use are the ones not submitted yet. */
+    if (sqeTail_ - sqeHead_ >= sqEntries_) {
+        return nullptr;
+    }
+    ::io_uring_sqe * sqe = &sqes_[sqeTail_ & sqMask_];
+    sqeTail_++;
+    ::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+unsigned
+IoUring::
+submit(unsigned waitFor)
+{
+    unsigned toSubmit = sqeTail_ - sqeHead_;
+    if (toSubmit == 0 && waitFor == 0) {
+        return 0;
+    }
+
+    unsigned tail = sqKTail_->load(std::memory_order_relaxed);
+    for (; sqeHead_ != sqeTail_; sqeHead_++, tail++) {
+        sqArray_[tail & sqMask_] = sqeHead_ & sqMask_;
+    }
+    sqKTail_->store(tail, std::memory_order_release);
+
+    unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (true) {
+        int res = ioUringEnter(fd_, toSubmit, waitFor, flags);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw MLDB::Exception(errno, "io_uring_enter");
+        }
+        ExcAssertEqual((unsigned) res, toSubmit);
+        break;
+    }
+
+    return toSubmit;
+}
+
+bool
+IoUring::
+popCompletion(::io_uring_cqe & cqe)
+{
+    unsigned head = cqKHead_->load(std::memory_order_relaxed);
+    if (head == cqKTail_->load(std::memory_order_acquire)) {
+        return false;
+    }
+    cqe = cqes_[head & cqMask_];
+    cqKHead_->store(head + 1, std::memory_order_release);
+    return true;
+}
+
+void
+IoUring::
+registerEventFd(int eventFd)
+{
+    int res = ioUringRegister(fd_, IORING_REGISTER_EVENTFD, &eventFd, 1);
+    if (res == -1) {
+        throw MLDB::Exception(errno, "io_uring_register eventfd");
+    }
+}
+
+void
+IoUring::
+registerBuffers(const ::iovec * iovecs, unsigned count)
+{
+    int res = ioUringRegister(fd_, IORING_REGISTER_BUFFERS, iovecs, count);
+    if (res == -1) {
+        throw MLDB::Exception(errno, "io_uring_register buffers");
+    }
+}
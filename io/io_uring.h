@@ -0,0 +1,117 @@
+// This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+/* io_uring.h                                                      -*- C++ -*-
+   Copyright (c) 2016 mldb.ai inc.  All rights reserved.
+
+   A minimal wrapper around a Linux io_uring instance, and the choice of the
+   backend used by the io classes.
+*/
+
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+#include <atomic>
+#include <string>
+
+
+namespace MLDB {
+
+/****************************************************************************/
+/* IO BACKEND                                                               */
+/****************************************************************************/
+
+/* Mechanism used to wait for and perform I/O on file descriptors. */
+
+enum class IoBackend {
+    EPOLL,      /* readiness notifications with epoll, then read(2)/write(2) */
+    IO_URING    /* operations submitted to and completed by an io_uring */
+};
+
+/* Return the backend used by sources created from now on. It is read once
+   from the MLDB_IO_BACKEND environment variable ("epoll" or "io_uring"),
+   and falls back to epoll when the kernel doesn't provide io_uring. */
+IoBackend getIoBackend();
+
+/* Change the backend used by sources created from now on. Throws if
+   IO_URING is requested but unavailable. */
+void setIoBackend(IoBackend backend);
+
+std::string to_string(IoBackend backend);
+
+
+/****************************************************************************/
+/* IO URING                                                                 */
+/****************************************************************************/
+
+/* An io_uring instance, driven with the raw system calls. Its submission
+ * and completion queues are single threaded: they must be used from one
+ * thread at a time. */
+
+struct IoUring {
+    IoUring(unsigned entries);
+    ~IoUring();
+
+    IoUring(const IoUring & other) = delete;
+    IoUring & operator = (const IoUring & other) = delete;
+
+    /* Whether the kernel provides io_uring, with the features needed by
+       the io classes. */
+    static bool available();
+
+    int fd() const
+    { return fd_; }
+
+    /* Return a zeroed submission queue entry to fill in, or nullptr if the
+       submission queue is full. The entry is submitted on the next call
+       to "submit". */
+    ::io_uring_sqe * getSqe();
+
+    /* Submit all the entries obtained since the last call, in a single
+       system call, and wait until at least "waitFor" completions are
+       available. Returns the number of entries submitted. */
+    unsigned submit(unsigned waitFor = 0);
+
+    /* Number of entries obtained but not submitted yet. */
+    unsigned pending() const
+    { return sqeTail_ - sqeHead_; }
+
+    /* Move the oldest completion into "cqe", returning false if there is
+       none. Completions are taken one at a time so that their handlers
+       can submit new entries or wait for other completions. */
+    bool popCompletion(::io_uring_cqe & cqe);
+
+    /* Signal "eventFd" whenever a completion is posted, so that the ring
+       can be waited on with epoll. */
+    void registerEventFd(int eventFd);
+
+    /* Register buffers for use by IORING_OP_READ_FIXED and
+       IORING_OP_WRITE_FIXED, which saves mapping them on each operation. */
+    void registerBuffers(const ::iovec * iovecs, unsigned count);
+
+private:
+    int fd_;
+
+    /* submission queue */
+    void * sqRing_;
+    size_t sqRingSize_;
+    ::io_uring_sqe * sqes_;
+    size_t sqesSize_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    std::atomic<unsigned> * sqKTail_;
+    unsigned * sqArray_;
+    unsigned sqeHead_;
+    unsigned sqeTail_;
+
+    /* completion queue */
+    void * cqRing_;
+    size_t cqRingSize_;
+    unsigned cqMask_;
+    std::atomic<unsigned> * cqKHead_;
+    std::atomic<unsigned> * cqKTail_;
+    ::io_uring_cqe * cqes_;
+};
+
+} // namespace MLDB
@@ -3,8 +3,8 @@
    Copyright (c) 2012 mldb.ai inc.  All rights reserved.
    This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
 
-   Ring buffer for when there are one or more producers and one consumer
-   chasing each other.
+   Ring buffers for when there are one or more producers and one or more
+   consumers chasing each other.
 */
 
 #pragma once
@@ -12,6 +12,10 @@
 #include <vector>
 #include "mldb/arch/futex.h"
 #include "mldb/arch/spinlock.h"
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
 #include <mutex>
 #include <thread>
 
@@ -399,5 +403,207 @@ struct RingBufferSRMW : public RingBufferBase<Request> {
     }
 };
 
+
+/*****************************************************************************/
+/* RING BUFFER MULTIPLE WRITERS MULTIPLE READERS                             */
+/*****************************************************************************/
+
+/** Bounded lock-free ring buffer for any number of writers and readers,
+    after Dmitry Vyukov's bounded MPMC queue.  Each cell carries a sequence
+    number that tells writers and readers whose turn it is, so that the
+    only contention is on the read and write positions, which are on
+    separate cache lines.
+
+    None of the operations block; callers that need to wait for space or
+    for messages do so on their own terms (see TypedMessageSink).
+*/
+template<typename Request>
+struct RingBufferMWMR {
+
+    /** Create a ring buffer with room for at least the given number of
+        entries; it's rounded up to a power of two.
+    */
+    RingBufferMWMR(size_t size)
+    {
+        size_t capacity = 2;
+        while (capacity < size)
+            capacity *= 2;
+        mask = capacity - 1;
+        cells.reset(new Cell[capacity]);
+        for (size_t i = 0;  i < capacity;  ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        writePosition.store(0, std::memory_order_relaxed);
+        readPosition.store(0, std::memory_order_relaxed);
+    }
+
+    RingBufferMWMR(const RingBufferMWMR & other) = delete;
+    RingBufferMWMR & operator = (const RingBufferMWMR & other) = delete;
+
+    bool tryPush(const Request & request)
+    {
+        Request copy(request);
+        return tryPush(std::move(copy));
+    }
+
+    /** Push the request, returning false (and leaving the request alone)
+        if the buffer is full.
+    */
+    bool tryPush(Request && request)
+    {
+        size_t pos;
+        Cell * cell = claim(writePosition, 0, pos);
+        if (!cell)
+            return false;
+        cell->data = std::move(request);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Move as many of the requests in [first, last) as there is room
+        for into the buffer, with a single update of the write position.
+        Returns the number pushed, which were the first ones.
+    */
+    template<typename It>
+    size_t tryPushMulti(It first, It last)
+    {
+        size_t pos;
+        size_t n = claimMulti(writePosition, 0, std::distance(first, last),
+                              pos);
+        for (size_t i = 0;  i < n;  ++i, ++first) {
+            Cell & cell = cells[(pos + i) & mask];
+            cell.data = std::move(*first);
+            cell.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return n;
+    }
+
+    /** Pop the oldest request into result, returning false if the buffer
+        is empty.
+    */
+    bool tryPop(Request & result)
+    {
+        size_t pos;
+        Cell * cell = claim(readPosition, 1, pos);
+        if (!cell)
+            return false;
+        result = std::move(cell->data);
+        cell->data = Request();
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Pop up to the given number of requests, with a single update of the
+        read position.
+    */
+    std::vector<Request> tryPopMulti(size_t nbrRequests)
+    {
+        std::vector<Request> result;
+        size_t pos;
+        size_t n = claimMulti(readPosition, 1, nbrRequests, pos);
+        result.reserve(n);
+        for (size_t i = 0;  i < n;  ++i) {
+            Cell & cell = cells[(pos + i) & mask];
+            result.emplace_back(std::move(cell.data));
+            cell.data = Request();
+            cell.sequence.store(pos + i + mask + 1,
+                                std::memory_order_release);
+        }
+        return result;
+    }
+
+    /** Returns true if there is a request ready to be popped.  A request
+        that is being pushed at the same time may or may not be seen.
+    */
+    bool couldPop() const
+    {
+        size_t pos = readPosition.load(std::memory_order_relaxed);
+        return cells[pos & mask].sequence.load(std::memory_order_acquire)
+            == pos + 1;
+    }
+
+    /// Approximate number of requests in the buffer
+    size_t size() const
+    {
+        size_t r = readPosition.load(std::memory_order_relaxed);
+        size_t w = writePosition.load(std::memory_order_relaxed);
+        return w > r ? w - r : 0;
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Request data;
+    };
+
+    /** Claim the next cell for writing (offset 0) or reading (offset 1),
+        returning nullptr if there is none.  A cell at position pos is
+        ready to be written when its sequence is pos, and to be read when
+        it's pos + 1.
+    */
+    Cell * claim(std::atomic<size_t> & position, size_t offset, size_t & pos)
+    {
+        pos = position.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell * cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + offset);
+            if (diff == 0) {
+                if (position.compare_exchange_weak
+                    (pos, pos + 1, std::memory_order_relaxed))
+                    return cell;
+            }
+            else if (diff < 0)
+                return nullptr;  // full (writing) or empty (reading)
+            else pos = position.load(std::memory_order_relaxed);
+        }
+    }
+
+    /** Claim up to maxCells consecutive cells for writing or reading,
+        returning how many.  Every cell is checked, since the ones before
+        the last may still be in use by a slower thread.
+    */
+    size_t claimMulti(std::atomic<size_t> & position, size_t offset,
+                      size_t maxCells, size_t & pos)
+    {
+        maxCells = std::min<size_t>(maxCells, mask + 1);
+        pos = position.load(std::memory_order_relaxed);
+        for (;;) {
+            size_t n = 0;
+            while (n < maxCells
+                   && (cells[(pos + n) & mask].sequence
+                       .load(std::memory_order_acquire)
+                       == pos + n + offset))
+                ++n;
+
+            if (n == 0) {
+                size_t seq = cells[pos & mask].sequence
+                    .load(std::memory_order_acquire);
+                if ((intptr_t)seq - (intptr_t)(pos + offset) < 0)
+                    return 0;
+                pos = position.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            if (position.compare_exchange_weak(pos, pos + n,
+                                               std::memory_order_relaxed))
+                return n;
+        }
+    }
+
+    // Read-only after construction; on its own cache line so that it's not
+    // invalidated by the updates of the positions.
+    alignas(64) std::unique_ptr<Cell[]> cells;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> writePosition;
+    alignas(64) std::atomic<size_t> readPosition;
+    char padding[64 - sizeof(std::atomic<size_t>)];
+};
+
 } // namespace MLDB
 
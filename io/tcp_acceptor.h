@@ -23,6 +23,21 @@ struct EventLoop;
 struct TcpAcceptorImpl;
 
 
+/****************************************************************************/
+/* REUSE PORT                                                               */
+/****************************************************************************/
+
+/* Whether a listening socket shares its port with other listening sockets
+ * through SO_REUSEPORT, in which case the kernel spreads the incoming
+ * connections over all of them. */
+
+enum ReusePort {
+    REUSE_PORT_NONE,   ///< The socket has the port to itself
+    REUSE_PORT_NEW,    ///< First socket of a group; the port must be free
+    REUSE_PORT_JOIN    ///< Join the group already listening on the port
+};
+
+
 /****************************************************************************/
 /* TCP ACCEPTOR                                                             */
 /****************************************************************************/
@@ -44,7 +59,8 @@ struct TcpAcceptor {
      * interface. Returns the effective port of the listening socket. */
     void listen(const PortRange & portRange,
                 const std::string & hostname = "localhost",
-                int backlog = 128);
+                int backlog = 128,
+                ReusePort reusePort = REUSE_PORT_NONE);
 
     /* Shutdowns the worker threads (except the main listening thread) as well
      * as the listening socket. */
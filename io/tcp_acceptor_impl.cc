@@ -29,6 +29,9 @@ using namespace MLDB;
 
 static asio::ip::tcp::resolver::iterator endIterator;
 
+typedef asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>
+    ReusePortOption;
+
 
 /****************************************************************************/
 /* TCP ACCEPTOR IMPL                                                        */
@@ -53,7 +56,8 @@ TcpAcceptorImpl::
 
 void
 TcpAcceptorImpl::
-listen(const PortRange & portRange, const string & hostname, int backlog)
+listen(const PortRange & portRange, const string & hostname, int backlog,
+       ReusePort reusePort)
 {
     ExcAssert(!hostname.empty());
 
@@ -68,13 +72,13 @@ listen(const PortRange & portRange, const string & hostname, int backlog)
         auto ep = result.endpoint();
         if (ep.protocol() == asio::ip::tcp::v4()) {
             if (!v4Endpoint_.isOpen()) {
-                v4Endpoint_.open(ep, portRange, backlog);
+                v4Endpoint_.open(ep, portRange, backlog, reusePort);
                 accept(v4Endpoint_);
             }
         }
         else if (ep.protocol() == asio::ip::tcp::v6()) {
             if (!v6Endpoint_.isOpen()) {
-                v6Endpoint_.open(ep, portRange, backlog);
+                v6Endpoint_.open(ep, portRange, backlog, reusePort);
                 accept(v6Endpoint_);
             }
         }
@@ -137,7 +141,7 @@ TcpAcceptorImpl::Endpoint::
 void
 TcpAcceptorImpl::Endpoint::
 open(const asio::ip::tcp::endpoint & asioEndpoint,
-     const PortRange & portRange, int backlog)
+     const PortRange & portRange, int backlog, ReusePort reusePort)
 {
     /* Exception safety: we close the socket if we could not bind it
        appropriately */
@@ -149,11 +153,31 @@ open(const asio::ip::tcp::endpoint & asioEndpoint,
     while (!isOpen_) {
         bool bound(false);
         for (int i = portRange.first; i < portRange.last; i++) {
+            bindEndpoint.port(i);
+            system::error_code ec;
+            if (reusePort == REUSE_PORT_NEW) {
+                /* Another group of SO_REUSEPORT sockets on the port would
+                   let us bind and share its connections, so we first check
+                   that a socket that doesn't share can bind */
+                asio::ip::tcp::acceptor probe(ioService_);
+                probe.open(bindEndpoint.protocol());
+                probe.set_option(asio::socket_base::reuse_address(true));
+                probe.bind(bindEndpoint, ec);
+                probe.close();
+                if (ec == asio::error::address_in_use) {
+                    continue;
+                }
+                if (ec) {
+                    throw MLDB::Exception("error binding socket: "
+                                          + ec.message());
+                }
+            }
             acceptorPtr.reset(new asio::ip::tcp::acceptor(ioService_));
             acceptorPtr->open(bindEndpoint.protocol());
             acceptorPtr->set_option(asio::socket_base::reuse_address(true));
-            bindEndpoint.port(i);
-            system::error_code ec;
+            if (reusePort != REUSE_PORT_NONE) {
+                acceptorPtr->set_option(ReusePortOption(true));
+            }
             acceptorPtr->bind(bindEndpoint, ec);
             if (!ec) {
                 bound = true;
@@ -70,6 +70,13 @@ requestWrite(string data, OnWritten onWritten)
     impl_->requestWrite(std::move(data), std::move(onWritten));
 }
 
+void
+TcpSocketHandler::
+requestWrite(vector<WriteBuffer> buffers, OnWritten onWritten)
+{
+    impl_->requestWrite(std::move(buffers), std::move(onWritten));
+}
+
 void
 TcpSocketHandler::
 disableNagle()
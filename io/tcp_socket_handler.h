@@ -8,7 +8,9 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 
 namespace boost
@@ -31,6 +33,49 @@ struct TcpSocketHandlerImpl;
 struct TcpSocket;
 
 
+/****************************************************************************/
+/* WRITE BUFFER                                                             */
+/****************************************************************************/
+
+/* A block of bytes to be written to a socket without being copied.  The
+ * owner keeps the bytes alive until the write has finished; it can be any
+ * reference-counted object, such as the string or the frozen memory region
+ * that holds them. */
+
+struct WriteBuffer {
+    WriteBuffer()
+        : data(nullptr), size(0)
+    {
+    }
+
+    WriteBuffer(const char * data, size_t size,
+                std::shared_ptr<const void> owner)
+        : data(data), size(size), owner(std::move(owner))
+    {
+    }
+
+    /* Takes over the given string. */
+    explicit WriteBuffer(std::string str)
+    {
+        auto strPtr = std::make_shared<std::string>(std::move(str));
+        data = strPtr->data();
+        size = strPtr->size();
+        owner = std::move(strPtr);
+    }
+
+    /* Bytes that live for the duration of the program, such as a string
+       literal. */
+    static WriteBuffer staticData(const char * data, size_t size)
+    {
+        return WriteBuffer(data, size, nullptr);
+    }
+
+    const char * data;
+    size_t size;
+    std::shared_ptr<const void> owner;
+};
+
+
 /****************************************************************************/
 /* TCP SOCKET HANDLER                                                       */
 /****************************************************************************/
@@ -65,6 +110,11 @@ struct TcpSocketHandler {
     /* Request the sending of a given payload. */
     void requestWrite(std::string data, OnWritten onWritten = nullptr);
 
+    /* Request the sending of the given buffers, one after the other, with
+       a single scatter-gather write where possible. */
+    void requestWrite(std::vector<WriteBuffer> buffers,
+                      OnWritten onWritten = nullptr);
+
     /* Request the reading of any available data from the socket. */
     void requestReceive();
 
@@ -96,6 +96,32 @@ requestWrite(string data, TcpSocketHandler::OnWritten onWritten)
     async_write(socket_, writeBuffer, writeCompleteCond, onWriteComplete);
 }
 
+void
+TcpSocketHandlerImpl::
+requestWrite(vector<WriteBuffer> buffers,
+             TcpSocketHandler::OnWritten onWritten)
+{
+    // The buffers stay alive until the write has completed
+    auto buffersPtr = std::make_shared<vector<WriteBuffer> >(std::move(buffers));
+    vector<asio::const_buffer> writeBuffers;
+    writeBuffers.reserve(buffersPtr->size());
+    for (auto & b: *buffersPtr) {
+        if (b.size > 0) {
+            writeBuffers.emplace_back(b.data, b.size);
+        }
+    }
+    auto onWriteComplete = [=] (const system::error_code & ec,
+                                size_t written)
+        mutable
+    {
+        if (onWritten) {
+            onWritten(ec, written);
+        }
+        buffersPtr.reset();
+    };
+    async_write(socket_, writeBuffers, onWriteComplete);
+}
+
 void
 TcpSocketHandlerImpl::
 disableNagle()
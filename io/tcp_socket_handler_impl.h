@@ -47,6 +47,10 @@ struct TcpSocketHandlerImpl {
     void requestWrite(std::string data,
                       TcpSocketHandler::OnWritten onWritten = nullptr);
 
+    /* Request the sending of the given buffers. */
+    void requestWrite(std::vector<WriteBuffer> buffers,
+                      TcpSocketHandler::OnWritten onWritten = nullptr);
+
     /* Request the reading of any available data from the socket. */
     void requestReceive();
 
@@ -1,6 +1,10 @@
 // This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
 
-/* async_writer_bench */
+/* async_writer_bench
+
+   Compares the throughput of AsyncWriterSource over pipes and sockets, with
+   each of the epoll and io_uring backends.
+*/
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -213,12 +217,23 @@ void doBench(const string & label,
 void benchFunction(const string & label,
                    std::function<pair<int, int> ()> f)
 {
-    int multiplier(1);
-    for (int i = 0; i < 4; i++) {
-        multiplier *= 10;
-        auto fds = f();
-        doBench(label, fds.first, fds.second,
-                10000000 / multiplier, 50 * multiplier);
+    vector<IoBackend> backends{IoBackend::EPOLL};
+    if (IoUring::available()) {
+        backends.push_back(IoBackend::IO_URING);
+    }
+    else {
+        ::fprintf(stderr, "io_uring is not available, not benchmarked\n");
+    }
+
+    for (IoBackend backend: backends) {
+        setIoBackend(backend);
+        int multiplier(1);
+        for (int i = 0; i < 4; i++) {
+            multiplier *= 10;
+            auto fds = f();
+            doBench(label + "/" + to_string(backend), fds.first, fds.second,
+                    10000000 / multiplier, 50 * multiplier);
+        }
     }
 }
 
@@ -0,0 +1,241 @@
+// This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+/* async_writer_source_test.cc
+   Copyright (c) 2016 mldb.ai inc.  All rights reserved.
+
+   Tests for AsyncWriterSource, with both the epoll and io_uring backends.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/io/async_writer_source.h"
+#include "mldb/io/message_loop.h"
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+struct TestSource : public AsyncWriterSource {
+    TestSource(int fd, const OnClosed & onClosed,
+               const OnReceivedData & onReceivedData,
+               size_t readBufferSize)
+        : AsyncWriterSource(onClosed, onReceivedData, nullptr, 0,
+                            readBufferSize)
+    {
+        setFd(fd);
+    }
+};
+
+vector<IoBackend> testedBackends()
+{
+    vector<IoBackend> result{IoBackend::EPOLL};
+    if (IoUring::available()) {
+        result.push_back(IoBackend::IO_URING);
+    }
+    else {
+        ::fprintf(stderr, "io_uring is not available, not tested\n");
+    }
+    return result;
+}
+
+/* Restores the backend at the end of a test */
+struct BackendGuard {
+    BackendGuard()
+        : saved(getIoBackend())
+    {
+    }
+
+    ~BackendGuard()
+    {
+        setIoBackend(saved);
+    }
+
+    IoBackend saved;
+};
+
+template<typename Fn>
+bool waitFor(Fn && fn, double seconds = 10.0)
+{
+    auto deadline = chrono::steady_clock::now()
+        + chrono::duration<double>(seconds);
+    while (!fn()) {
+        if (chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    return true;
+}
+
+} // file scope
+
+
+BOOST_AUTO_TEST_CASE( test_write_and_read )
+{
+    BackendGuard guard;
+
+    for (IoBackend backend: testedBackends()) {
+        BOOST_TEST_MESSAGE("backend " + to_string(backend));
+        setIoBackend(backend);
+
+        int fds[2];
+        BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK,
+                                       0, fds), 0);
+
+        mutex lock;
+        string received;
+        auto onReceivedData = [&] (const char * data, size_t size) {
+            lock_guard<mutex> guard(lock);
+            received.append(data, size);
+        };
+        atomic<int> numResults(0);
+        auto onWriteResult = [&] (AsyncWriteResult result) {
+            BOOST_CHECK_EQUAL(result.error, 0);
+            BOOST_CHECK_EQUAL(result.writtenSize, result.written.size());
+            numResults++;
+        };
+
+        MessageLoop loop;
+        loop.start();
+        auto writer = make_shared<TestSource>(fds[0], nullptr, nullptr, 0);
+        auto reader = make_shared<TestSource>(fds[1], nullptr,
+                                              onReceivedData, 4096);
+        BOOST_CHECK(writer->backend() == backend);
+        loop.addSource("writer", writer);
+        loop.addSource("reader", reader);
+
+        /* Enough data to fill the socket buffers several times */
+        string expected;
+        const int numMessages = 10000;
+        for (int i = 0; i < numMessages; i++) {
+            string message = to_string(i) + string(100, 'x') + "\n";
+            expected += message;
+            while (!writer->write(message, onWriteResult)) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+        }
+
+        BOOST_CHECK(waitFor([&] { return numResults == numMessages; }));
+        BOOST_CHECK(waitFor([&] {
+                    lock_guard<mutex> guard(lock);
+                    return received.size() >= expected.size();
+                }));
+        BOOST_CHECK_EQUAL(writer->msgsSent(), numMessages);
+        BOOST_CHECK_EQUAL(writer->bytesSent(), expected.size());
+        BOOST_CHECK_EQUAL(reader->bytesReceived(), expected.size());
+        {
+            lock_guard<mutex> guard(lock);
+            BOOST_CHECK(received == expected);
+        }
+
+        loop.removeSourceSync(writer.get());
+        loop.removeSourceSync(reader.get());
+        loop.shutdown();
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_request_close )
+{
+    BackendGuard guard;
+
+    for (IoBackend backend: testedBackends()) {
+        BOOST_TEST_MESSAGE("backend " + to_string(backend));
+        setIoBackend(backend);
+
+        int fds[2];
+        BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK,
+                                       0, fds), 0);
+
+        atomic<int> writerClosed(0), readerClosedByPeer(0);
+        atomic<size_t> received(0);
+        auto onWriterClosed = [&] (bool fromPeer, const vector<string> &) {
+            BOOST_CHECK(!fromPeer);
+            writerClosed++;
+        };
+        auto onReaderClosed = [&] (bool fromPeer, const vector<string> &) {
+            if (fromPeer) {
+                readerClosedByPeer++;
+            }
+        };
+        auto onReceivedData = [&] (const char * data, size_t size) {
+            received += size;
+        };
+
+        MessageLoop loop;
+        loop.start();
+        auto writer = make_shared<TestSource>(fds[0], onWriterClosed,
+                                              nullptr, 0);
+        auto reader = make_shared<TestSource>(fds[1], onReaderClosed,
+                                              onReceivedData, 4096);
+        loop.addSource("writer", writer);
+        loop.addSource("reader", reader);
+
+        /* Messages queued before the close request are all sent first */
+        for (int i = 0; i < 100; i++) {
+            writer->write(string(1000, 'a'), nullptr);
+        }
+        writer->requestClose();
+
+        BOOST_CHECK(waitFor([&] { return writerClosed == 1; }));
+        BOOST_CHECK(waitFor([&] { return readerClosedByPeer == 1; }));
+        BOOST_CHECK_EQUAL(received, 100000);
+        BOOST_CHECK(!writer->queueEnabled());
+
+        loop.removeSourceSync(writer.get());
+        loop.removeSourceSync(reader.get());
+        loop.shutdown();
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_peer_closes_write_only )
+{
+    BackendGuard guard;
+
+    for (IoBackend backend: testedBackends()) {
+        BOOST_TEST_MESSAGE("backend " + to_string(backend));
+        setIoBackend(backend);
+
+        int fds[2];
+        BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK,
+                                       0, fds), 0);
+
+        atomic<int> closedByPeer(0);
+        auto onClosed = [&] (bool fromPeer, const vector<string> &) {
+            if (fromPeer) {
+                closedByPeer++;
+            }
+        };
+
+        MessageLoop loop;
+        loop.start();
+        auto writer = make_shared<TestSource>(fds[0], onClosed, nullptr, 0);
+        loop.addSource("writer", writer);
+
+        ::close(fds[1]);
+        BOOST_CHECK(waitFor([&] { return closedByPeer == 1; }));
+
+        loop.removeSourceSync(writer.get());
+        loop.shutdown();
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_backend_names )
+{
+    BOOST_CHECK_EQUAL(to_string(IoBackend::EPOLL), "epoll");
+    BOOST_CHECK_EQUAL(to_string(IoBackend::IO_URING), "io_uring");
+}
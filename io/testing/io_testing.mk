@@ -2,6 +2,7 @@
 
 $(eval $(call test,asio_timer_test,io_base,boost))
 $(eval $(call test,async_writer_bench,io_base,boost))
+$(eval $(call test,async_writer_source_test,io_base,boost))
 $(eval $(call test,epoll_test,io_base,boost))
 $(eval $(call test,message_channel_test,io_base,boost))
 $(eval $(call test,message_loop_test,io_base,boost))
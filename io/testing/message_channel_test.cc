@@ -102,49 +102,82 @@ BOOST_AUTO_TEST_CASE( test_typed_message_queue )
         /* testing constructor */
         BOOST_CHECK_EQUAL(queue.maxMessages_, 5);
         BOOST_CHECK_EQUAL(queue.pending_, false);
-        BOOST_CHECK_EQUAL(queue.queue_.size(), 0);
+        BOOST_CHECK_EQUAL(queue.size(), 0);
 
         /* push */
         queue.push_back("first message");
         BOOST_CHECK_EQUAL(queue.pending_, true);
-        BOOST_CHECK_EQUAL(queue.queue_.size(), 1);
-        BOOST_CHECK_EQUAL(queue.queue_.front(), "first message");
+        BOOST_CHECK_EQUAL(queue.size(), 1);
         BOOST_CHECK_EQUAL(numNotifications, 0);
 
         /* process one */
         queue.processOne();
         /* only "pop_front" affects "pending_" */
         BOOST_CHECK_EQUAL(queue.pending_, true);
-        BOOST_CHECK_EQUAL(queue.queue_.size(), 1);
+        BOOST_CHECK_EQUAL(queue.size(), 1);
         BOOST_CHECK_EQUAL(numNotifications, 1);
 
-        queue.queue_.pop();
         queue.processOne();
-        /* only "pop_front" affects "pending_" */
         BOOST_CHECK_EQUAL(queue.pending_, true);
-        BOOST_CHECK_EQUAL(queue.queue_.size(), 0);
         BOOST_CHECK_EQUAL(numNotifications, 2);
 
-        /* pop front 1: a single element */
-        queue.queue_.emplace("first message");
+        /* pop front 1: a single element, which empties the queue */
         auto msgs = queue.pop_front(1);
         BOOST_CHECK_EQUAL(msgs.size(), 1);
         BOOST_CHECK_EQUAL(msgs[0], "first message");
-        BOOST_CHECK_EQUAL(queue.queue_.size(), 0);
+        BOOST_CHECK_EQUAL(queue.size(), 0);
+        BOOST_CHECK_EQUAL(queue.pending_, false);
 
         /* pop front 2: too many elements requested */
-        queue.queue_.emplace("blabla 1");
-        queue.queue_.emplace("blabla 2");
+        queue.push_back("blabla 1");
+        queue.push_back("blabla 2");
         msgs = queue.pop_front(10);
         BOOST_CHECK_EQUAL(msgs.size(), 2);
-        BOOST_CHECK_EQUAL(queue.queue_.size(), 0);
+        BOOST_CHECK_EQUAL(queue.size(), 0);
 
         /* pop front 3: all elements requested */
-        queue.queue_.emplace("blabla 1");
-        queue.queue_.emplace("blabla 2");
+        queue.push_back("blabla 1");
+        queue.push_back("blabla 2");
         msgs = queue.pop_front(0);
         BOOST_CHECK_EQUAL(msgs.size(), 2);
-        BOOST_CHECK_EQUAL(queue.queue_.size(), 0);
+        BOOST_CHECK_EQUAL(msgs[0], "blabla 1");
+        BOOST_CHECK_EQUAL(msgs[1], "blabla 2");
+        BOOST_CHECK_EQUAL(queue.size(), 0);
+
+        /* the limit on the number of messages */
+        for (int i = 0; i < 5; i++) {
+            BOOST_CHECK(queue.push_back("message " + to_string(i)));
+        }
+        BOOST_CHECK(!queue.push_back("one too many"));
+        BOOST_CHECK_EQUAL(queue.size(), 5);
+        queue.setMaxMessages(6);
+        BOOST_CHECK(queue.push_back("message 5"));
+        msgs = queue.pop_front(0);
+        BOOST_CHECK_EQUAL(msgs.size(), 6);
+    }
+
+    /* more messages than the ring buffer holds go to the overflow queue,
+       in order */
+    {
+        TypedMessageQueue<int> queue;
+        int numMessages = 3 * TypedMessageQueue<int>::RING_SIZE;
+        for (int i = 0; i < numMessages; i++) {
+            BOOST_CHECK(queue.push_back(i));
+        }
+        BOOST_CHECK_GT(queue.overflowSize_, 0);
+        BOOST_CHECK_EQUAL(queue.size(), numMessages);
+
+        /* pushes while there is an overflow go behind it */
+        auto msgs = queue.pop_front(10);
+        queue.push_back(numMessages);
+        auto rest = queue.pop_front(0);
+        msgs.insert(msgs.end(), rest.begin(), rest.end());
+        BOOST_REQUIRE_EQUAL(msgs.size(), numMessages + 1);
+        for (int i = 0; i <= numMessages; i++) {
+            BOOST_CHECK_EQUAL(msgs[i], i);
+        }
+        BOOST_CHECK_EQUAL(queue.size(), 0);
+        BOOST_CHECK_EQUAL(queue.overflowSize_, 0);
     }
 
     /* multiple producers and a MessageLoop */
@@ -209,3 +242,90 @@ BOOST_AUTO_TEST_CASE( test_typed_message_queue )
 }
 
 } // namespace MLDB
+
+BOOST_AUTO_TEST_CASE( test_ring_buffer_mwmr )
+{
+    RingBufferMWMR<int> ring(5);
+    BOOST_CHECK_EQUAL(ring.capacity(), 8);
+    BOOST_CHECK(!ring.couldPop());
+
+    int value;
+    BOOST_CHECK(!ring.tryPop(value));
+
+    /* batches, including ones that only partly fit */
+    vector<int> values{1, 2, 3, 4, 5, 6};
+    BOOST_CHECK_EQUAL(ring.tryPushMulti(values.begin(), values.end()), 6);
+    BOOST_CHECK_EQUAL(ring.tryPushMulti(values.begin(), values.end()), 2);
+    BOOST_CHECK(!ring.tryPush(7));
+    BOOST_CHECK_EQUAL(ring.size(), 8);
+
+    BOOST_CHECK(ring.couldPop());
+    BOOST_CHECK(ring.tryPop(value));
+    BOOST_CHECK_EQUAL(value, 1);
+    auto popped = ring.tryPopMulti(100);
+    BOOST_CHECK_EQUAL(popped, vector<int>({2, 3, 4, 5, 6, 1, 2}));
+    BOOST_CHECK(!ring.couldPop());
+    BOOST_CHECK(ring.tryPopMulti(100).empty());
+
+    /* several producers and consumers, with wraparound */
+    const int numThreads = 4;
+    const int numPerThread = 20000;
+    vector<atomic<int> > seen(numThreads * numPerThread);
+    atomic<int> numPopped(0);
+
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t] () {
+                vector<int> batch;
+                for (int i = 0; i < numPerThread; i++) {
+                    int value = t * numPerThread + i;
+                    if (i % 3 == 0) {
+                        while (!ring.tryPush(value)) {
+                            std::this_thread::yield();
+                        }
+                        continue;
+                    }
+                    batch.push_back(value);
+                    if (batch.size() == 4 || i == numPerThread - 1) {
+                        size_t done = 0;
+                        while (done < batch.size()) {
+                            done += ring.tryPushMulti(batch.begin() + done,
+                                                      batch.end());
+                            std::this_thread::yield();
+                        }
+                        batch.clear();
+                    }
+                }
+            });
+        threads.emplace_back([&, t] () {
+                while (numPopped < numThreads * numPerThread) {
+                    int value;
+                    if (t % 2) {
+                        if (ring.tryPop(value)) {
+                            seen[value]++;
+                            numPopped++;
+                            continue;
+                        }
+                    }
+                    else {
+                        auto values = ring.tryPopMulti(3);
+                        for (int value: values) {
+                            seen[value]++;
+                            numPopped++;
+                        }
+                        if (!values.empty()) {
+                            continue;
+                        }
+                    }
+                    std::this_thread::yield();
+                }
+            });
+    }
+    for (auto & t: threads) {
+        t.join();
+    }
+
+    for (auto & s: seen) {
+        BOOST_CHECK_EQUAL(s.load(), 1);
+    }
+}
@@ -9,8 +9,11 @@
 
 #pragma once
 
-#include <queue>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <thread>
+#include <vector>
 
 #include "mldb/io/ring_buffer.h"
 #include "mldb/arch/wakeup_fd.h"
@@ -21,32 +24,46 @@ namespace MLDB {
 
 template<typename Message>
 struct TypedMessageChannel {
-    MLDB::RingBufferSRMW<Message> buf;
+    MLDB::RingBufferMWMR<Message> buf;
 };
 
+/* A bounded channel of messages from any number of threads to the thread
+ * of a MessageLoop. The wakeup fd is only signaled when the consumer may be
+ * waiting, ie once after the channel went from empty to non-empty, rather
+ * than on every message. */
 template<typename Message>
 struct TypedMessageSink: public AsyncEventSource {
 
     TypedMessageSink(size_t bufferSize)
-        : wakeup(EFD_NONBLOCK), buf(bufferSize)
+        : wakeup(EFD_NONBLOCK), buf(bufferSize), signaled(false)
     {
     }
 
     std::function<void (Message && message)> onEvent;
 
+    /* Push the message, waiting for room if the buffer is full */
     template<typename MessageT>
     void push(MessageT&& message)
     {
-        buf.push(std::forward<MessageT>(message));
-        wakeup.signal();
+        Message msg(std::forward<MessageT>(message));
+        for (int i = 0; !buf.tryPush(std::move(msg)); i++) {
+            if (i < 100) {
+                std::this_thread::yield();
+            }
+            else {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+        notify();
     }
 
     template<typename MessageT>
     bool tryPush(MessageT&& message)
     {
-        bool pushed = buf.tryPush(std::forward<MessageT>(message));
+        Message msg(std::forward<MessageT>(message));
+        bool pushed = buf.tryPush(std::move(msg));
         if (pushed)
-            wakeup.signal();
+            notify();
 
         return pushed;
     }
@@ -73,18 +90,30 @@ struct TypedMessageSink: public AsyncEventSource {
         // Are there more waiting for us?
         if (buf.couldPop())
             return true;
-        
-        // Warning: race condition... that's why we need the couldPop from
-        // the next instruction to be accurate
-        wakeup.tryRead();
 
+        // We're about to wait: rearm the wakeup, and look again for
+        // messages pushed by producers that saw it still signaled. The
+        // fences pair with the one in notify().
+        wakeup.tryRead();
+        signaled.store(false);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
         return buf.couldPop();
     }
 
-    uint64_t size() const { return buf.ring.size() ; }
+    uint64_t size() const { return buf.capacity(); }
 private:
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!signaled.exchange(true))
+            wakeup.signal();
+    }
+
     MLDB::WakeupFd wakeup;
-    MLDB::RingBufferSRMW<Message> buf;
+    MLDB::RingBufferMWMR<Message> buf;
+
+    /* the wakeup fd has been signaled and not read since */
+    std::atomic<bool> signaled;
 };
 
 
@@ -97,6 +126,11 @@ class test_typed_message_queue;
 /* A multiple writer/consumer thread-safe message queue similar to the above
  * but only optionally bounded. When bounded, the advantage over the above is
  * that the limit can be dynamically adjusted.
+ *
+ * Messages go through a lock-free ring buffer. When it's full, they are
+ * appended to a locked overflow queue instead, as are all the messages
+ * pushed while the overflow queue isn't empty, so that the messages of each
+ * producer are received in the order in which it pushed them.
 */
 template<typename Message>
 struct TypedMessageQueue: public AsyncEventSource
@@ -115,7 +149,11 @@ struct TypedMessageQueue: public AsyncEventSource
      * queue
      * "maxMessages": maximum size of the queue, 0 for unlimited */
     TypedMessageQueue(const OnNotify & onNotify = nullptr, size_t maxMessages = 0)
-        : maxMessages_(maxMessages),
+        : ring_(RING_SIZE),
+          overflowSize_(0),
+          size_(0),
+          reserved_(0),
+          maxMessages_(maxMessages),
           wakeup_(EFD_NONBLOCK | EFD_CLOEXEC),
           pending_(false),
           onNotify_(onNotify)
@@ -156,15 +194,26 @@ struct TypedMessageQueue: public AsyncEventSource
     /* push message into the queue */
     bool push_back(Message message)
     {
-        Guard guard(queueLock_);
+        size_t maxMessages = maxMessages_;
+        if (maxMessages > 0) {
+            if (reserved_.fetch_add(1) >= maxMessages) {
+                reserved_--;
+                return false;
+            }
+        }
+        else {
+            reserved_++;
+        }
 
-        if (maxMessages_ > 0 && queue_.size() >= maxMessages_) {
-            return false;
+        if (overflowSize_.load() > 0 || !ring_.tryPush(std::move(message))) {
+            Guard guard(overflowLock_);
+            overflow_.emplace_back(std::move(message));
+            overflowSize_++;
         }
 
-        queue_.emplace(std::move(message));
-        if (!pending_) {
-            pending_ = true;
+        size_++;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!pending_.exchange(true)) {
             wakeup_.signal();
         }
 
@@ -174,22 +223,42 @@ struct TypedMessageQueue: public AsyncEventSource
     /* returns up to "number" messages from the queue or all of them if 0 */
     std::vector<Message> pop_front(size_t number)
     {
-        std::vector<Message> messages;
-        Guard guard(queueLock_);
-
-        size_t queueSize = queue_.size();
-        if (number == 0 || number > queueSize) {
-            number = queueSize;
+        if (number == 0) {
+            number = size_t(-1);
         }
-        messages.reserve(number);
 
-        for (size_t i = 0; i < number; i++) {
-            messages.emplace_back(std::move(queue_.front()));
-            queue_.pop();
+        /* The overflow queue only has messages that were pushed after those
+           in the ring, so we only look at it once the ring is empty */
+        std::vector<Message> messages = ring_.tryPopMulti(number);
+        while (messages.size() < number) {
+            auto more = ring_.tryPopMulti(number - messages.size());
+            if (more.empty()) {
+                break;
+            }
+            for (auto & message: more) {
+                messages.emplace_back(std::move(message));
+            }
         }
+        if (messages.size() < number && overflowSize_.load() > 0) {
+            Guard guard(overflowLock_);
+            while (messages.size() < number && !overflow_.empty()) {
+                messages.emplace_back(std::move(overflow_.front()));
+                overflow_.pop_front();
+            }
+            overflowSize_ = overflow_.size();
+        }
+
+        size_ -= messages.size();
+        reserved_ -= messages.size();
 
-        if (queue_.size() == 0) {
+        if (size_.load() <= 0) {
+            /* Clear the notification, unless a message was pushed in the
+               meantime by a producer that saw it still pending. */
             pending_ = false;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (size_.load() > 0 && !pending_.exchange(true)) {
+                wakeup_.signal();
+            }
         }
 
         return messages;
@@ -198,20 +267,33 @@ struct TypedMessageQueue: public AsyncEventSource
     /* number of messages present in the queue */
     uint64_t size() const
     {
-        Guard guard(queueLock_);
-        return queue_.size();
+        /* A message can be popped before its producer counts it */
+        int64_t size = size_;
+        return size > 0 ? size : 0;
     }
 
 private:
+    /* Number of messages that the ring buffer can hold before overflowing */
+    static constexpr size_t RING_SIZE = 256;
+
     typedef std::mutex Mutex;
     typedef std::unique_lock<Mutex> Guard;
-    mutable Mutex queueLock_;
-    std::queue<Message> queue_;
-    size_t maxMessages_;
+    RingBufferMWMR<Message> ring_;
+    mutable Mutex overflowLock_;
+    std::deque<Message> overflow_;
+    std::atomic<size_t> overflowSize_;
+
+    /* messages that have been pushed */
+    std::atomic<int64_t> size_;
+
+    /* messages that have been or are being pushed, for "maxMessages_" */
+    std::atomic<size_t> reserved_;
+
+    std::atomic<size_t> maxMessages_;
 
     MLDB::WakeupFd wakeup_;
 
-    /* notifications are pending; protected by queueLock_ */
+    /* notifications are pending */
     std::atomic<bool> pending_;
 
     /* callback */
@@ -9,9 +9,15 @@
 
 #include "mldb/logging/logging.h"
 #include "mldb/base/exc_check.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/types/json_printing.h"
 
 #include <iostream>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
 #include <unordered_map>
 #include <vector>
 #include <sys/time.h>
@@ -19,6 +25,30 @@
 
 namespace MLDB {
 
+namespace {
+
+void formatTime(const timeval & time, char * text, size_t size)
+{
+    tm local;
+    localtime_r(&time.tv_sec, &local);
+    auto count = strftime(text, size, "%Y-%m-%d %H:%M:%S", &local);
+    int ms = time.tv_usec / 1000;
+    snprintf(text + count, size - count, ".%03d", ms);
+}
+
+} // file scope
+
+void Logging::Writer::write(Entry & entry) {
+    char text[64];
+    formatTime(entry.time, text, sizeof(text));
+    head(text, entry.name.c_str(), entry.function, entry.file, entry.line);
+    if (entry.numSuppressed) {
+        entry.text = "(" + std::to_string(entry.numSuppressed)
+            + " earlier messages suppressed by the rate limit) " + entry.text;
+    }
+    body(entry.text);
+}
+
 void Logging::ConsoleWriter::head(char const * timestamp,
                                   char const * name,
                                   char const * function,
@@ -85,6 +115,40 @@ void Logging::JsonWriter::head(char const * timestamp,
            << ",\"text\":\"";
 }
 
+void Logging::JsonWriter::write(Entry & entry) {
+    char text[64];
+    formatTime(entry.time, text, sizeof(text));
+
+    // The message usually comes with its endl
+    if (!entry.text.empty() && entry.text.back() == '\n')
+        entry.text.pop_back();
+
+    auto field = [&] (char const * name, std::string const & value) {
+        stream << ",\"" << name << "\":\"";
+        jsonEscape(value, stream);
+        stream << '"';
+    };
+
+    stream << "{\"time\":\"" << text << '"';
+    field("name", entry.name);
+    field("call", entry.function);
+    field("file", entry.file);
+    stream << ",\"line\":" << entry.line;
+    if (entry.numSuppressed)
+        stream << ",\"suppressed\":" << entry.numSuppressed;
+    field("text", entry.text);
+    stream << "}\n";
+
+    if(!writer) {
+        std::cerr << stream.str();
+    }
+    else {
+        writer->body(stream.str());
+    }
+
+    stream.str("");
+}
+
 void Logging::JsonWriter::body(std::string const & content) {
     stream.write(content.c_str(), content.size() - 1);
     stream << "\"}\n";
@@ -98,6 +162,202 @@ void Logging::JsonWriter::body(std::string const & content) {
     stream.str("");
 }
 
+/*****************************************************************************/
+/* ASYNC WRITER                                                              */
+/*****************************************************************************/
+
+struct Logging::AsyncWriter::Itl {
+
+    /** Buffer of the messages of one thread.  The thread is the only
+        one to append to it, and the draining thread (which holds
+        drainLock) the only one to take messages out, so the two
+        positions are all that need to be synchronized.
+    */
+    struct Buffer {
+        Buffer(size_t capacity)
+            : entries(capacity)
+        {
+        }
+
+        std::vector<Entry> entries;
+        alignas(64) std::atomic<uint64_t> readPos{0};
+        alignas(64) std::atomic<uint64_t> writePos{0};
+    };
+
+    Itl(std::shared_ptr<Writer> output, size_t bufferSize, double flushInterval)
+        : output(std::move(output)),
+          flushInterval(flushInterval),
+          id(nextId++)
+    {
+        ExcCheck(this->output, "AsyncWriter needs an output");
+        ExcCheckGreater(bufferSize, 1, "AsyncWriter buffers are too small");
+        ExcCheckGreater(flushInterval, 0.0, "AsyncWriter needs a flush interval");
+        this->bufferSize = 1;
+        while (this->bufferSize < bufferSize)
+            this->bufferSize *= 2;
+
+        thread = std::thread([this] () { run(); });
+    }
+
+    ~Itl()
+    {
+        {
+            std::unique_lock<std::mutex> guard(wakeupLock);
+            shutdown = true;
+        }
+        wakeup.notify_one();
+        thread.join();
+        drain();
+    }
+
+    std::shared_ptr<Writer> output;
+    size_t bufferSize;
+    std::chrono::duration<double> flushInterval;
+    uint64_t id;   ///< Never reused, unlike the address of the writer
+
+    std::mutex buffersLock;
+    std::vector<std::shared_ptr<Buffer> > buffers;
+
+    std::mutex drainLock;
+    std::atomic<uint64_t> numDropped{0};
+    uint64_t numDroppedReported = 0;
+
+    std::mutex wakeupLock;
+    std::condition_variable wakeup;
+    bool shutdown = false;
+    std::thread thread;
+
+    static std::atomic<uint64_t> nextId;
+
+    Buffer & threadBuffer()
+    {
+        // Holding a reference keeps the buffer alive until it's drained,
+        // even when the thread exits first
+        thread_local std::unordered_map<uint64_t, std::shared_ptr<Buffer> >
+            threadBuffers;
+
+        auto & result = threadBuffers[id];
+        if (!result) {
+            result = std::make_shared<Buffer>(bufferSize);
+            std::unique_lock<std::mutex> guard(buffersLock);
+            buffers.push_back(result);
+        }
+        return *result;
+    }
+
+    void write(Entry & entry)
+    {
+        Buffer & buffer = threadBuffer();
+        uint64_t writePos = buffer.writePos.load(std::memory_order_relaxed);
+        uint64_t readPos = buffer.readPos.load(std::memory_order_acquire);
+        uint64_t used = writePos - readPos;
+        if (used == bufferSize) {
+            numDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        buffer.entries[writePos & (bufferSize - 1)] = std::move(entry);
+        buffer.writePos.store(writePos + 1, std::memory_order_release);
+
+        if (used + 1 == bufferSize / 2)
+            wakeup.notify_one();
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> guard(wakeupLock);
+        while (!shutdown) {
+            wakeup.wait_for(guard, flushInterval);
+            guard.unlock();
+            drain();
+            guard.lock();
+        }
+    }
+
+    /** Write out everything that the threads have buffered. */
+    void drain()
+    {
+        std::unique_lock<std::mutex> guard(drainLock);
+
+        std::vector<std::shared_ptr<Buffer> > toDrain;
+        {
+            std::unique_lock<std::mutex> guard(buffersLock);
+            toDrain = buffers;
+        }
+
+        std::vector<Entry> entries;
+        for (auto & buffer: toDrain) {
+            uint64_t readPos = buffer->readPos.load(std::memory_order_relaxed);
+            uint64_t writePos = buffer->writePos.load(std::memory_order_acquire);
+            for (uint64_t i = readPos;  i < writePos;  ++i) {
+                entries.emplace_back
+                    (std::move(buffer->entries[i & (bufferSize - 1)]));
+            }
+            buffer->readPos.store(writePos, std::memory_order_release);
+        }
+        toDrain.clear();
+
+        // Interleave the messages of the different threads
+        std::stable_sort(entries.begin(), entries.end(),
+                         [] (const Entry & e1, const Entry & e2)
+                         {
+                             return timercmp(&e1.time, &e2.time, <);
+                         });
+
+        uint64_t dropped = numDropped.load(std::memory_order_relaxed);
+        if (dropped != numDroppedReported) {
+            Entry entry;
+            gettimeofday(&entry.time, 0);
+            entry.name = "logging";
+            entry.function = __PRETTY_FUNCTION__;
+            entry.file = __FILE__;
+            entry.line = __LINE__;
+            entry.text = std::to_string(dropped - numDroppedReported)
+                + " log messages were dropped because a buffer was full\n";
+            entry.numSuppressed = 0;
+            entries.emplace_back(std::move(entry));
+            numDroppedReported = dropped;
+        }
+
+        for (auto & entry: entries)
+            output->write(entry);
+
+        // Forget the buffers of threads that have exited once they are
+        // empty; nobody else can write to them
+        std::unique_lock<std::mutex> buffersGuard(buffersLock);
+        buffers.erase(std::remove_if(buffers.begin(), buffers.end(),
+                                     [] (const std::shared_ptr<Buffer> & b)
+                                     {
+                                         return b.use_count() == 1
+                                             && b->readPos == b->writePos;
+                                     }),
+                      buffers.end());
+    }
+};
+
+std::atomic<uint64_t> Logging::AsyncWriter::Itl::nextId{1};
+
+Logging::AsyncWriter::AsyncWriter(std::shared_ptr<Writer> output,
+                                  size_t bufferSize,
+                                  double flushInterval)
+    : itl(new Itl(std::move(output), bufferSize, flushInterval)) {
+}
+
+Logging::AsyncWriter::~AsyncWriter() {
+}
+
+void Logging::AsyncWriter::write(Entry & entry) {
+    itl->write(entry);
+}
+
+void Logging::AsyncWriter::flush() {
+    itl->drain();
+}
+
+uint64_t Logging::AsyncWriter::numDropped() const {
+    return itl->numDropped.load(std::memory_order_relaxed);
+}
+
 namespace {
 
 struct Registry {
@@ -116,10 +376,20 @@ Registry& getRegistry() {
 
 struct Logging::CategoryData {
     bool initialized;
-    bool enabled;
+    std::atomic<bool> enabled;
     char const * name;
     std::shared_ptr<Writer> writer;
-    std::stringstream stream;
+
+    /* The rate limit is a generic cell rate algorithm: each message pushes
+       the theoretical arrival time forward by the interval, and a message
+       is only written if that leaves it no further than the burst ahead
+       of now.  Times are in nanoseconds on the steady clock.
+    */
+    std::atomic<bool> rateLimited;
+    std::atomic<int64_t> rateInterval;
+    std::atomic<int64_t> rateBurst;
+    std::atomic<int64_t> theoreticalArrival;
+    std::atomic<uint64_t> numSuppressed;
 
     CategoryData * parent;
     std::vector<std::shared_ptr<CategoryData> > children;
@@ -134,6 +404,8 @@ struct Logging::CategoryData {
     void activate(bool recurse = true);
     void deactivate(bool recurse = true);
     void writeTo(std::shared_ptr<Writer> output, bool recurse = true);
+    void setRateLimit(double messagesPerSecond, double burst, bool recurse);
+    bool admitRateLimited();
 
     ~CategoryData() {
     }
@@ -144,6 +416,11 @@ private:
         initialized(false),
         enabled(enabled),
         name(name),
+        rateLimited(false),
+        rateInterval(0),
+        rateBurst(0),
+        theoreticalArrival(0),
+        numSuppressed(0),
         parent(nullptr) {
     }
 };
@@ -263,25 +540,62 @@ void Logging::CategoryData::writeTo(std::shared_ptr<Writer> output, bool recurse
     }
 }
 
+void Logging::CategoryData::setRateLimit(double messagesPerSecond, double burst, bool recurse) {
+    if (messagesPerSecond > 0) {
+        int64_t interval = 1e9 / messagesPerSecond;
+        rateInterval = std::max<int64_t>(interval, 1);
+        rateBurst = std::max(burst, 1.0) * rateInterval;
+        rateLimited = true;
+    }
+    else rateLimited = false;
+
+    if(recurse) {
+        for(auto item : children) {
+            item->setRateLimit(messagesPerSecond, burst, recurse);
+        }
+    }
+}
+
+bool Logging::CategoryData::admitRateLimited() {
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t interval = rateInterval.load(std::memory_order_relaxed);
+    int64_t burst = rateBurst.load(std::memory_order_relaxed);
+
+    int64_t arrival = theoreticalArrival.load(std::memory_order_relaxed);
+    for (;;) {
+        int64_t newArrival = std::max(arrival, now) + interval;
+        if (newArrival - now > burst) {
+            numSuppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (theoreticalArrival.compare_exchange_weak(arrival, newArrival,
+                                                     std::memory_order_relaxed))
+            return true;
+    }
+}
+
 Logging::Category& Logging::Category::root() {
     static Category root(CategoryData::getRoot());
     return root;
 }
 
 Logging::Category::Category(std::shared_ptr<CategoryData> data) :
-    data(data) {
+    data(data),
+    enabled(&this->data->enabled),
+    rateLimited(&this->data->rateLimited) {
 }
 
 Logging::Category::Category(char const * name, Category & super, bool enabled) :
-    data(CategoryData::create(name, super.name(), enabled)) {
+    Category(CategoryData::create(name, super.name(), enabled)) {
 }
 
 Logging::Category::Category(char const * name, char const * super, bool enabled) :
-    data(CategoryData::create(name, super, enabled)) {
+    Category(CategoryData::create(name, super, enabled)) {
 }
 
 Logging::Category::Category(char const * name, bool enabled) :
-    data(CategoryData::create(name, "*", enabled)) {
+    Category(CategoryData::create(name, "*", enabled)) {
 }
 
 Logging::Category::~Category()
@@ -293,12 +607,8 @@ char const * Logging::Category::name() const {
     return data->name;
 }
 
-bool Logging::Category::isEnabled() const {
-    return data->enabled;
-}
-
-bool Logging::Category::isDisabled() const {
-    return !data->enabled;
+bool Logging::Category::admitRateLimited() const {
+    return data->admitRateLimited();
 }
 
 auto Logging::Category::getWriter() const -> std::shared_ptr<Writer> const &
@@ -318,40 +628,74 @@ void Logging::Category::writeTo(std::shared_ptr<Writer> output, bool recurse) {
     data->writeTo(output, recurse);
 }
 
-// This lock is a quick-fix for the case where a category is used by multiple
-// threads. Note that this lock should either eventually be removed or replaced
-// by a per category lock. Unfortunately the current setup makes it very
-// difficult to pass the header information to the operator& so that everything
-// can be dumped in the stream in one go.
-namespace { std::mutex loggingMutex; }
+void Logging::Category::setRateLimit(double messagesPerSecond, double burst, bool recurse) {
+    data->setRateLimit(messagesPerSecond, burst, recurse);
+}
+
+// Writers that aren't thread-safe are called under this lock.  The message
+// itself is formatted before it's taken, into a stream that belongs to the
+// logging thread.
+namespace {
+
+std::mutex loggingMutex;
+
+struct PendingWrite {
+    std::ostringstream stream;
+    timeval time;
+    char const * function;
+    char const * file;
+    int line;
+};
+
+PendingWrite & pendingWrite() {
+    thread_local PendingWrite result;
+    return result;
+}
+
+} // file scope
 
 std::ostream & Logging::Category::beginWrite(char const * fct, char const * file, int line) {
-    loggingMutex.lock();
+    PendingWrite & pending = pendingWrite();
+    gettimeofday(&pending.time, 0);
+    pending.function = fct;
+    pending.file = file;
+    pending.line = line;
+    return pending.stream;
+}
 
-    timeval now;
-    gettimeofday(&now, 0);
-    char text[64];
-    auto count = strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", localtime(&now.tv_sec));
-    int ms = now.tv_usec / 1000;
-    sprintf(text + count, ".%03d", ms);
-    data->writer->head(text, data->name, fct, file, line);
-    return data->stream;
+void Logging::Category::endWrite(std::ostream & stream) {
+    PendingWrite & pending = pendingWrite();
+    ExcAssert(&stream == &pending.stream);
+
+    Entry entry;
+    entry.time = pending.time;
+    entry.name = data->name;
+    entry.function = pending.function;
+    entry.file = pending.file;
+    entry.line = pending.line;
+    entry.text = pending.stream.str();
+    entry.numSuppressed = data->numSuppressed.load(std::memory_order_relaxed)
+        ? data->numSuppressed.exchange(0) : 0;
+    pending.stream.str("");
+
+    std::shared_ptr<Writer> writer = data->writer;
+    if (writer->isThreadSafe()) {
+        writer->write(entry);
+    }
+    else {
+        std::lock_guard<std::mutex> guard(loggingMutex);
+        writer->write(entry);
+    }
 }
 
 void Logging::Printer::operator&(std::ostream & stream) {
-    std::stringstream & text = (std::stringstream &) stream;
-    category.getWriter()->body(text.str());
-    text.str("");
-
-    loggingMutex.unlock();
+    category.endWrite(stream);
 }
 
 void Logging::Thrower::operator&(std::ostream & stream) {
-
-    std::stringstream & text = (std::stringstream &) stream;
-    std::string message(text.str());
-    text.str("");
-    loggingMutex.unlock();
+    PendingWrite & pending = pendingWrite();
+    std::string message(pending.stream.str());
+    pending.stream.str("");
 
     throw MLDB::Exception(message);
 }
@@ -47,15 +47,34 @@
      Logging::Category print("print");
      print.writeTo(std::make_shared<CustomWriter>());
 
-   At the moment, there are 3 types of writers that are usable:
+   At the moment, there are 4 types of writers that are usable:
 
      - ConsoleWriter
      - FileWriter
      - JsonWriter
+     - AsyncWriter
 
-  NOTE: Those writers aren't thread-safe at the moment. Use with care
-  accross threads.
+  Messages are formatted into a buffer of the logging thread.  Writers
+  that aren't thread-safe (the first three) are called under a global
+  lock, so a slow output stalls every thread that logs.  Wrapping one in
+  an AsyncWriter moves the output to a background thread; the logging
+  threads then only append to a buffer of their own, without taking a
+  lock.  This is what to use when turning on diagnostics in production.
 
+   For example:
+
+     Logging::Category debug("debug", false);
+     debug.writeTo(std::make_shared<Logging::AsyncWriter>
+                       (std::make_shared<Logging::JsonWriter>()));
+     debug.setRateLimit(100); // messages per second
+     debug.activate();
+
+   A category can be rate limited, in which case the messages over the
+   limit aren't formatted at all; the number that were suppressed is
+   reported with the next one that is written.
+
+   DEBUG_LOG works like LOG, but can be compiled out entirely by defining
+   MLDB_DEBUG_LOGGING to 0.  The code is still type checked.
 */
 
 #pragma once
@@ -65,16 +84,42 @@
 #include <sstream>
 #include <unistd.h>
 #include <functional>
+#include <atomic>
+#include <memory>
+#include <sys/time.h>
 #include "mldb/types/date.h"
 
 namespace MLDB {
 
 struct Logging
 {
+    /** A message to be written. */
+    struct Entry {
+        timeval time;
+        std::string name;          ///< Name of the category
+        char const * function;
+        char const * file;
+        int line;
+        std::string text;
+        uint64_t numSuppressed;    ///< Earlier ones over the rate limit
+    };
+
     struct Writer {
         virtual ~Writer() {
         }
 
+        /** Write the whole message.  The default formats the timestamp
+            and calls head() then body().
+        */
+        virtual void write(Entry & entry);
+
+        /** Whether write() may be called by several threads at once.  If
+            not, calls are serialized by a global lock.
+        */
+        virtual bool isThreadSafe() const {
+            return false;
+        }
+
         virtual void head(char const * timestamp,
                           char const * name,
                           char const * function,
@@ -128,11 +173,16 @@ struct Logging
         std::stringstream stream;
     };
 
+    /** Writes each message as a single line JSON object, with its
+        timestamp, category, source location and text.
+    */
     struct JsonWriter : public Writer {
         JsonWriter(std::shared_ptr<Writer> const & writer = std::shared_ptr<Writer>()) :
             writer(writer) {
         }
 
+        void write(Entry & entry) override;
+
         void head(char const * timestamp,
                   char const * name,
                   char const * function,
@@ -146,6 +196,39 @@ struct Logging
         std::stringstream stream;
     };
 
+    /** Writer that hands messages to a background thread, which writes
+        them to another writer.  Each logging thread appends to its own
+        lock-free buffer of bufferSize messages and never waits for the
+        output; when its buffer is full, messages are dropped and
+        counted instead.  The background thread writes what has been
+        buffered, in timestamp order, every flushInterval seconds or as
+        soon as a buffer is half full.
+    */
+    struct AsyncWriter : public Writer {
+        AsyncWriter(std::shared_ptr<Writer> output,
+                    size_t bufferSize = 4096,
+                    double flushInterval = 0.05);
+
+        /// Writes out everything that is buffered
+        ~AsyncWriter();
+
+        void write(Entry & entry) override;
+
+        bool isThreadSafe() const override {
+            return true;
+        }
+
+        /** Wait until everything logged so far has been written. */
+        void flush();
+
+        /** Number of messages dropped because a buffer was full. */
+        uint64_t numDropped() const;
+
+    private:
+        struct Itl;
+        std::unique_ptr<Itl> itl;
+    };
+
     struct CategoryData;
 
     struct Category {
@@ -159,8 +242,22 @@ struct Logging
 
         char const * name() const;
 
-        bool isEnabled() const;
-        bool isDisabled() const;
+        bool isEnabled() const {
+            return enabled->load(std::memory_order_relaxed);
+        }
+
+        bool isDisabled() const {
+            return !isEnabled();
+        }
+
+        /** Whether a message should be written now, which is when the
+            category is enabled and within its rate limit.  This counts
+            as sending a message for the rate limit, so is only for LOG.
+        */
+        bool admit() const {
+            return isEnabled() && (!rateLimited->load(std::memory_order_relaxed)
+                                   || admitRateLimited());
+        }
 
         /// Type that is convertible to bool but nothing else for operator bool
         typedef void (Category::* boolConvertibleType)() const;
@@ -188,13 +285,29 @@ struct Logging
         void activate(bool recurse = true);
         void deactivate(bool recurse = true);
 
+        /** Write at most messagesPerSecond messages on average, and at
+            most burst of them at once.  Zero removes the limit.
+        */
+        void setRateLimit(double messagesPerSecond, double burst = 10,
+                          bool recurse = true);
+
+        /** Start a message; the returned stream belongs to this thread
+            until endWrite() is called.
+        */
         std::ostream & beginWrite(char const * function, char const * file, int line);
 
+        /** Hand the message in the stream to the writer. */
+        void endWrite(std::ostream & stream);
+
         static Category& root();
 
     private:
         Category(std::shared_ptr<CategoryData> data);
         std::shared_ptr<CategoryData> data;
+        const std::atomic<bool> * enabled;
+        const std::atomic<bool> * rateLimited;
+
+        bool admitRateLimited() const;
 
         // operator bool result
         void dummy() const {}
@@ -232,6 +345,10 @@ struct Logging
             return !done && Date::now().secondsSince(print) < delta;
         }
 
+        bool admit() {
+            return !isDisabled();
+        }
+
         std::ostream & beginWrite(char const * function, char const * file, int line) {
             print = Date::now();
             return category.beginWrite(function, file, line);
@@ -270,7 +387,19 @@ struct Logging
     LOG(errors) << "error frobbing: " << errorMessage << endl;
 */
 #define LOG(group, ...) \
-    group.isDisabled() ? (void) 0 : Logging::Printer(group) & \
+    !group.admit() ? (void) 0 : Logging::Printer(group) & \
+    group.beginWrite(__PRETTY_FUNCTION__, __FILE__, __LINE__ __VA_ARGS__)
+
+#ifndef MLDB_DEBUG_LOGGING
+# define MLDB_DEBUG_LOGGING 1
+#endif
+
+/** Same as LOG, but when MLDB_DEBUG_LOGGING is defined to 0 the message
+    is never written nor its arguments evaluated, and the compiler removes
+    the statement.  For logging in the hottest paths.
+*/
+#define DEBUG_LOG(group, ...) \
+    (!MLDB_DEBUG_LOGGING || !group.admit()) ? (void) 0 : Logging::Printer(group) & \
     group.beginWrite(__PRETTY_FUNCTION__, __FILE__, __LINE__ __VA_ARGS__)
 
 /** Macro to log a thrown exeption to the given group and then throw it.  Usage is
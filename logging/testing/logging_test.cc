@@ -13,6 +13,10 @@
 #include "mldb/logging/logging.h"
 
 #include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <algorithm>
 
 using namespace std;
 using namespace MLDB;
@@ -48,3 +52,149 @@ BOOST_AUTO_TEST_CASE(blah)
     BOOST_CHECK(!d.isEnabled());
     BOOST_CHECK(!e.isEnabled());
 }
+
+namespace {
+
+/// Writer that remembers what it was given
+struct RecordingWriter : public Logging::Writer {
+    void write(Logging::Entry & entry) override {
+        std::unique_lock<std::mutex> guard(lock);
+        entries.push_back(entry);
+    }
+
+    void body(std::string const & content) override {
+        std::unique_lock<std::mutex> guard(lock);
+        bodies.push_back(content);
+    }
+
+    std::mutex lock;
+    std::vector<Logging::Entry> entries;
+    std::vector<std::string> bodies;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(test_async_writer)
+{
+    auto recorder = std::make_shared<RecordingWriter>();
+    auto writer = std::make_shared<Logging::AsyncWriter>(recorder, 1 << 16);
+
+    Logging::Category async("async");
+    async.writeTo(writer);
+    async.activate();
+
+    int numThreads = 4, numPerThread = 1000;
+    std::vector<std::thread> threads;
+    for (int t = 0;  t < numThreads;  ++t) {
+        threads.emplace_back([&, t] ()
+                             {
+                                 for (int i = 0;  i < numPerThread;  ++i)
+                                     LOG(async) << t << " " << i << endl;
+                             });
+    }
+    for (auto & t: threads)
+        t.join();
+
+    writer->flush();
+    BOOST_CHECK_EQUAL(writer->numDropped(), 0);
+    BOOST_REQUIRE_EQUAL(recorder->entries.size(), numThreads * numPerThread);
+
+    // Each thread's messages are in order, and all are in timestamp order
+    std::vector<int> next(numThreads);
+    for (size_t i = 0;  i < recorder->entries.size();  ++i) {
+        auto & entry = recorder->entries[i];
+        BOOST_CHECK_EQUAL(entry.name, "async");
+        int t, n;
+        BOOST_REQUIRE_EQUAL(sscanf(entry.text.c_str(), "%d %d", &t, &n), 2);
+        BOOST_CHECK_EQUAL(n, next.at(t)++);
+        if (i > 0)
+            BOOST_CHECK(!timercmp(&entry.time,
+                                  &recorder->entries[i - 1].time, <));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_async_writer_full_buffer)
+{
+    auto recorder = std::make_shared<RecordingWriter>();
+    // The background thread won't get a chance to drain before we're done
+    auto writer = std::make_shared<Logging::AsyncWriter>(recorder, 16, 1000.0);
+
+    Logging::Category full("full");
+    full.writeTo(writer);
+    full.activate();
+
+    int numMessages = 10000;
+    for (int i = 0;  i < numMessages;  ++i)
+        LOG(full) << i << endl;
+
+    // Messages that didn't fit were dropped rather than blocking, and the
+    // number dropped is reported
+    writer->flush();
+    BOOST_CHECK_GT(writer->numDropped(), 0);
+    size_t numWritten = 0, numReported = 0;
+    for (auto & entry: recorder->entries) {
+        if (entry.name == "logging")
+            numReported += std::stoull(entry.text);
+        else ++numWritten;
+    }
+    BOOST_CHECK_EQUAL(numWritten + writer->numDropped(), numMessages);
+    BOOST_CHECK_EQUAL(numReported, writer->numDropped());
+}
+
+BOOST_AUTO_TEST_CASE(test_rate_limit)
+{
+    auto recorder = std::make_shared<RecordingWriter>();
+    Logging::Category limited("limited");
+    limited.writeTo(recorder);
+    limited.activate();
+    limited.setRateLimit(0.001 /* per second */, 5 /* burst */);
+
+    int numEvaluated = 0;
+    auto evaluate = [&] () { return ++numEvaluated; };
+    for (int i = 0;  i < 100;  ++i)
+        LOG(limited) << evaluate() << endl;
+
+    // Only the burst was written, and the others weren't even formatted
+    BOOST_CHECK_EQUAL(recorder->entries.size(), 5);
+    BOOST_CHECK_EQUAL(numEvaluated, 5);
+
+    // Without the limit, the next message says how many were suppressed
+    limited.setRateLimit(0);
+    LOG(limited) << "after" << endl;
+    BOOST_REQUIRE_EQUAL(recorder->entries.size(), 6);
+    BOOST_CHECK_EQUAL(recorder->entries.back().numSuppressed, 95);
+}
+
+BOOST_AUTO_TEST_CASE(test_json_writer)
+{
+    auto recorder = std::make_shared<RecordingWriter>();
+    Logging::Category json("json");
+    json.writeTo(std::make_shared<Logging::JsonWriter>(recorder));
+    json.activate();
+
+    LOG(json) << "quote \" and\nnewline" << endl;
+
+    BOOST_REQUIRE_EQUAL(recorder->bodies.size(), 1);
+    const std::string & line = recorder->bodies[0];
+    BOOST_CHECK_EQUAL(line.back(), '\n');
+    BOOST_CHECK_EQUAL(std::count(line.begin(), line.end(), '\n'), 1);
+    BOOST_CHECK_NE(line.find("\"name\":\"json\""), std::string::npos);
+    BOOST_CHECK_NE(line.find("\"text\":\"quote \\\" and\\nnewline\""),
+                   std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(test_debug_log)
+{
+    auto recorder = std::make_shared<RecordingWriter>();
+    Logging::Category debug("debug");
+    debug.writeTo(recorder);
+    debug.activate();
+
+    DEBUG_LOG(debug) << "written" << endl;
+    BOOST_CHECK_EQUAL(recorder->entries.size(), MLDB_DEBUG_LOGGING ? 1 : 0);
+
+    debug.deactivate();
+    DEBUG_LOG(debug) << "not written" << endl;
+    LOG(debug) << "not written" << endl;
+    BOOST_CHECK_EQUAL(recorder->entries.size(), MLDB_DEBUG_LOGGING ? 1 : 0);
+}
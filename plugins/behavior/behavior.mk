@@ -5,6 +5,7 @@
 LIBBEHAVIOR_SOURCES := \
 	behavior_domain.cc \
 	mapped_behavior_domain.cc \
+	lazy_remote_file.cc \
 	mutable_behavior_domain.cc \
 	merged_behavior_domain.cc \
 	mapped_value.cc \
@@ -708,6 +708,7 @@ BehaviorDataset(MldbEngine * owner,
     //result->isFrozen_ = true;
     columns = std::make_shared<BehaviorColumnIndex>(behs);
     matrix = std::make_shared<BehaviorMatrixView>(behs, columns->index);
+    dataChanged();
 }
 
 BehaviorDataset::
@@ -820,7 +821,7 @@ getRowStream() const
 
 MutableBehaviorDatasetConfig::
 MutableBehaviorDatasetConfig() 
-    : timeQuantumSeconds(1.0)
+    : timeQuantumSeconds(1.0), timeIndexBucketSeconds(0.0)
 {
 }
 
@@ -835,6 +836,13 @@ MutableBehaviorDatasetConfigDescription()
              "a number that controls the resolution of timestamps stored in the dataset, "
              "in seconds. 1 means one second, 0.001 means one millisecond, 60 means one minute. "
              "Higher resolution requires more memory to store timestamps.", 1.0);
+    addField("timeIndexBucketSeconds",
+             &MutableBehaviorDatasetConfig::timeIndexBucketSeconds,
+             "if non-zero, the file written on commit contains an index of "
+             "which rows had each column in each period of this many "
+             "seconds, for example 86400 for days.  This makes finding the "
+             "rows with a column in a time range fast, at the cost of a "
+             "larger file and a slower commit.  0 writes no index.", 0.0);
 }
 
 /*****************************************************************************/
@@ -851,6 +859,7 @@ MutableBehaviorDataset(MldbEngine * owner,
     auto params = config.params.convert<MutableBehaviorDatasetConfig>();
     behs.reset(new MutableBehaviorDomain());
     behs->timeQuantum = params.timeQuantumSeconds;
+    behs->timeIndexBucketSeconds = params.timeIndexBucketSeconds;
     this->address = params.dataFileUrl.toString();
 }
 
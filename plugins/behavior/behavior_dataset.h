@@ -80,6 +80,7 @@ struct MutableBehaviorDatasetConfig : BehaviorDatasetConfig
 {
     MutableBehaviorDatasetConfig();
     double timeQuantumSeconds; 
+    double timeIndexBucketSeconds;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(MutableBehaviorDatasetConfig);
@@ -30,6 +30,7 @@
 
 //#include <gperftools/tcmalloc.h>
 #include <atomic>
+#include <sstream>
 
 
 using namespace std;
@@ -293,6 +294,19 @@ saveToStream(std::ostream & stream,
     store.save_binary(mdOffset);
 }
 
+/** Serialize an ID on its own.  Variable length IDs are serialized in
+    parallel this way, and then written to the store in order.
+*/
+static std::string serializeId(const Id & id)
+{
+    std::ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+        store << id;
+    }
+    return stream.str();
+}
+
 template<typename T1, typename T2>
 void checkedSet(T1 & val, T2 setTo)
 {
@@ -475,6 +489,17 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
     std::vector<KVEntry<BH, uint32_t> >
         behaviorToIndex(nKept);
 
+    // Getting the stats means scanning the behavior, so do it in parallel
+    std::vector<BehaviorStats> keptStats(nKept);
+
+    auto getKeptStats = [&] (int i)
+        {
+            keptStats[i] = getBehaviorStats(std::get<0>(subjectCounts[i]),
+                                            BS_ALL & ~BS_SUBJECT_COUNT);
+        };
+
+    parallelMap(0, nKept, getKeptStats);
+
     for (unsigned i = 0;  i < nKept;  ++i) {
         BH beh;
         int sc;
@@ -482,7 +507,7 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
 
         std::tie(beh, sc, first) = subjectCounts[i];
 
-        auto stats = getBehaviorStats(beh, BS_ALL & ~BS_SUBJECT_COUNT);
+        const BehaviorStats & stats = keptStats[i];
 
         BehaviorInfo & info = allInfo[beh];
         info.subjectCount = sc;
@@ -522,11 +547,20 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
 
     // In-order list of IDs
     vector<uint32_t> idOffsets(nKept, 0);
-    for (unsigned i = 0;  i < nKept;  ++i) {
-        checkedSet(idOffsets[i], store.offset() - behaviorIdOffset);
-        BH beh = behByIndex[i];
-        store << allInfo[beh].id;
-    }
+
+    auto serializeBehaviorId = [&] (int i)
+        {
+            return serializeId(keptStats[i].id);
+        };
+
+    auto writeBehaviorId = [&] (int i, const std::string & serialized)
+        {
+            checkedSet(idOffsets[i], store.offset() - behaviorIdOffset);
+            store.save_binary(serialized.data(), serialized.size());
+        };
+
+    parallelMapInOrderReduceChunked(0, nKept, serializeBehaviorId,
+                                    writeBehaviorId, 1024);
 
     if (debug) {
         cerr << "finished writing behavior IDs at  " << t.elapsed() << endl;
@@ -1107,8 +1141,7 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
    
     uint64_t subjectIndexOffset = store.offset();
 
-    for (unsigned i = 0; i < index.size();  ++i)
-        store.save_binary(index[i]);
+    store.save_binary(index.data(), index.size() * sizeof(index[0]));
 
     if (debug) {
         cerr << "finished writing subject index at " << t.elapsed() << endl;
@@ -1121,11 +1154,15 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
         BehaviorEntryToWrite(uint32_t * subjectsBuf = 0,
                               size_t subjectsWords = 0,
                               uint32_t * timestampsBuf = 0,
-                              size_t timestampsWords = 0)
+                              size_t timestampsWords = 0,
+                              uint32_t * timeIndexBuf = 0,
+                              size_t timeIndexWords = 0)
             : subjectsBuf(subjectsBuf),
               subjectsWords(subjectsWords),
               timestampsBuf(timestampsBuf),
-              timestampsWords(timestampsWords)
+              timestampsWords(timestampsWords),
+              timeIndexBuf(timeIndexBuf),
+              timeIndexWords(timeIndexWords)
         {
         }
 
@@ -1133,8 +1170,18 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
         size_t subjectsWords;
         uint32_t * timestampsBuf;
         size_t timestampsWords;
+        uint32_t * timeIndexBuf;
+        size_t timeIndexWords;
     };
 
+    bool writeTimeIndex = timeIndexBucketSeconds > 0;
+    int64_t firstTimeIndexBucket = 0;
+    if (writeTimeIndex) {
+        firstTimeIndexBucket = MappedBehaviorDomain::getTimeIndexBucket
+            (unQuantizeTime(quantizeTime(earliestTime())),
+             timeIndexBucketSeconds);
+    }
+
     auto serializeBehaviorSubjects = [&] (const vector<uint32_t> & indexes)
         {
             uint64_t numBits = indexes.size() * numSubjectBits;
@@ -1189,6 +1236,58 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
             return make_pair(buf, numWords);
         };
 
+    // The time index entry for the behavior; see MappedBehaviorDomain
+    auto serializeBehaviorTimeIndex = [&] (BH beh)
+        {
+            // (bucket, subject index) for every event
+            vector<pair<uint32_t, uint32_t> > entries;
+            for (auto & s: getSubjectHashesAndAllTimestamps(beh)) {
+                Date ts = unQuantizeTime(quantizeTime(s.second));
+                int64_t bucket = MappedBehaviorDomain::getTimeIndexBucket
+                    (ts, timeIndexBucketSeconds) - firstTimeIndexBucket;
+                ExcAssertGreaterEqual(bucket, 0);
+                auto it = subjectToIndex.find(s.first);
+                if (it == subjectToIndex.end())
+                    throw MLDB::Exception("subject not found");
+                entries.emplace_back(bucket, it->second);
+            }
+
+            std::sort(entries.begin(), entries.end());
+            entries.erase(std::unique(entries.begin(), entries.end()),
+                          entries.end());
+
+            vector<pair<uint32_t, uint32_t> > buckets;
+            for (auto & e: entries) {
+                if (buckets.empty() || buckets.back().first != e.first)
+                    buckets.emplace_back(e.first, 0);
+                ++buckets.back().second;
+            }
+
+            uint64_t numWords = 1 + 2 * buckets.size();
+            for (auto & b: buckets)
+                numWords += ((uint64_t)b.second * numSubjectBits + 31) / 32;
+
+            uint32_t * buf = new uint32_t[numWords];
+            memset(buf, 0, numWords * 4);
+
+            buf[0] = buckets.size();
+            for (unsigned j = 0;  j < buckets.size();  ++j) {
+                buf[1 + j * 2] = buckets[j].first;
+                buf[2 + j * 2] = buckets[j].second;
+            }
+
+            uint32_t * list = buf + 1 + 2 * buckets.size();
+            auto it = entries.begin();
+            for (auto & b: buckets) {
+                Bit_Writer<uint32_t> writer(list);
+                for (unsigned j = 0;  j < b.second;  ++j, ++it)
+                    writer.write(it->second, numSubjectBits);
+                list += ((uint64_t)b.second * numSubjectBits + 31) / 32;
+            }
+
+            return make_pair(buf, numWords);
+        };
+
     auto serializeBehavior = [&] (int i) -> BehaviorEntryToWrite
         {
             BH beh = std::get<0>(subjectCounts[i]);
@@ -1233,8 +1332,13 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
             auto buf2 = serializeBehaviorTimestamps(beh, latestTimestamp,
                                                  subjects);
 
+            pair<uint32_t *, size_t> buf3(nullptr, 0);
+            if (writeTimeIndex)
+                buf3 = serializeBehaviorTimeIndex(beh);
+
             return BehaviorEntryToWrite(buf1.first, buf1.second,
-                                         buf2.first, buf2.second);
+                                         buf2.first, buf2.second,
+                                         buf3.first, buf3.second);
         };
 
     // For each behavior, a list of subjects
@@ -1248,6 +1352,14 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
     std::vector<pair<uint32_t *, size_t> > timestampBlocks;
     timestampBlocks.reserve(nKept);
 
+    // And the time index here
+    std::vector<uint64_t> timeIndex;
+    std::vector<pair<uint32_t *, size_t> > timeIndexBlocks;
+    if (writeTimeIndex) {
+        timeIndex.reserve(nKept + 1);
+        timeIndexBlocks.reserve(nKept);
+    }
+
     auto writeBehavior = [&] (int i, const BehaviorEntryToWrite & entry)
         {
             {
@@ -1269,6 +1381,14 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
                 timestampBlockOffset += entry.timestampsWords;
                 timestampBlocks.push_back({entry.timestampsBuf, entry.timestampsWords});
             }
+
+            if (writeTimeIndex) {
+                uint64_t ofs = timeIndex.empty() ? 0
+                    : timeIndex.back() + timeIndexBlocks.back().second;
+                timeIndex.push_back(ofs);
+                timeIndexBlocks.push_back({entry.timeIndexBuf,
+                                           entry.timeIndexWords});
+            }
         };
 
 #if 0 // debug only; slow
@@ -1370,29 +1490,54 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
         t.restart();
     }
 
+    uint64_t timeIndexDataOffset = 0, timeIndexOffset = 0;
+
+    if (writeTimeIndex) {
+        timeIndexDataOffset = store.offset();
+        uint64_t words = 0;
+        for (auto entry: timeIndexBlocks) {
+            store.save_binary(entry.first, entry.second * 4);
+            words += entry.second;
+            delete[] entry.first;
+        }
+        timeIndex.push_back(words);
+
+        timeIndexOffset = store.offset();
+        store.save_binary(timeIndex.data(),
+                          timeIndex.size() * sizeof(uint64_t));
+    }
+
     uint64_t subjectIdDataOffset = 0, subjectIdIndexOffset = 0;
 
     if (hasSubjectIds) {
         subjectIdDataOffset = store.offset();
 
-        // Write the subject IDs to the store
-        std::vector<uint32_t> subjectIdOffsets;
-        
-        for (unsigned i = 0;  i < index.size();  ++i) {
-            SH subject = index[i].key;
-            Id id = getSubjectId(subject);
-            subjectIdOffsets.push_back(store.offset() - subjectIdDataOffset);
-            store << id;
-        }
+        // Write the subject IDs to the store.  Looking them up can be
+        // expensive (eg, for a merged domain), so it's done in parallel.
+        std::vector<uint32_t> subjectIdOffsets(index.size());
+
+        auto serializeSubjectId = [&] (int i)
+            {
+                return serializeId(getSubjectId(index[i].key));
+            };
+
+        auto writeSubjectId = [&] (int i, const std::string & serialized)
+            {
+                checkedSet(subjectIdOffsets[i],
+                           store.offset() - subjectIdDataOffset);
+                store.save_binary(serialized.data(), serialized.size());
+            };
+
+        parallelMapInOrderReduceChunked(0, index.size(), serializeSubjectId,
+                                        writeSubjectId, 1024);
     
         //cerr << "subjectIdOffsets.back() = " << subjectIdOffsets.back()
         //     << endl;
 
         subjectIdIndexOffset = store.offset();
 
-        for (unsigned i = 0;  i < subjectIdOffsets.size();  ++i) {
-            store.save_binary(subjectIdOffsets[i]);
-        }
+        store.save_binary(subjectIdOffsets.data(),
+                          subjectIdOffsets.size() * sizeof(uint32_t));
     }
 
     uint64_t fileMetadataOffset = store.offset();
@@ -1431,6 +1576,10 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
     metadata.idSpaceDeprecated = 0;
     metadata.fileMetadataOffset = fileMetadataOffset;
     metadata.totalEventsRecorded = totalEventsRecorded;
+    metadata.timeIndexOffset = timeIndexOffset;
+    metadata.timeIndexDataOffset = timeIndexDataOffset;
+    metadata.timeIndexBucketSeconds
+        = writeTimeIndex ? timeIndexBucketSeconds : 0;
 
     store.save_binary(metadata);
 
@@ -1907,6 +2056,72 @@ coIterateBehaviorsImpl(Beh beh1, Beh beh2,
     return res;
 }
 
+std::vector<SH>
+BehaviorDomain::
+getSubjectsWithAllBehaviors(const std::vector<BH> & behs,
+                            SH maxSubject) const
+{
+    if (behs.empty())
+        return {};
+
+    std::vector<BH> sortedBehs = behs;
+    std::sort(sortedBehs.begin(), sortedBehs.end(),
+              [&] (BH beh1, BH beh2)
+              {
+                  return getBehaviorSubjectCount(beh1)
+                      < getBehaviorSubjectCount(beh2);
+              });
+
+    vector<SH> result = getSubjectHashes(sortedBehs[0], maxSubject,
+                                         true /* sorted */);
+
+    for (size_t i = 1;  i < sortedBehs.size() && !result.empty();  ++i) {
+        vector<SH> subs = getSubjectHashes(sortedBehs[i], maxSubject,
+                                           true /* sorted */);
+        vector<SH> both;
+        std::set_intersection(result.begin(), result.end(),
+                              subs.begin(), subs.end(),
+                              std::back_inserter(both));
+        result.swap(both);
+    }
+
+    return result;
+}
+
+std::vector<SH>
+BehaviorDomain::
+getSubjectsWithAnyBehavior(const std::vector<BH> & behs,
+                           SH maxSubject) const
+{
+    vector<SH> result;
+    for (BH beh: behs) {
+        vector<SH> subs = getSubjectHashes(beh, maxSubject, true /* sorted */);
+        result.insert(result.end(), subs.begin(), subs.end());
+    }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+
+    return result;
+}
+
+std::vector<SH>
+BehaviorDomain::
+getSubjectsWithBehaviorBetween(BH beh, Date earliest, Date latest,
+                               SH maxSubject) const
+{
+    vector<SH> result;
+    for (auto & s: getSubjectHashesAndAllTimestamps(beh, maxSubject,
+                                                    true /* sorted */)) {
+        if (s.second >= earliest && s.second < latest)
+            result.push_back(s.first);
+    }
+
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+
+    return result;
+}
+
 int
 BehaviorDomain::
 coIterateBehaviors(BH beh1, BH beh2,
@@ -277,7 +277,7 @@ struct BehaviorDomain {
     BehaviorDomain(int minSubjects = 1, double timeQuantum = 1.0,
                     bool hasSubjectIds = true)
         : minSubjects(minSubjects), timeQuantum(timeQuantum),
-          hasSubjectIds(hasSubjectIds)
+          hasSubjectIds(hasSubjectIds), timeIndexBucketSeconds(0)
     {
     }
 
@@ -522,6 +522,28 @@ struct BehaviorDomain {
     getSubjectHashes(BH beh, SH maxSubject = SH(-1), bool sorted = false)
         const = 0;
 
+    /** Return the sorted subjects that have all of the given behaviors.
+        Default implementation intersects the subject lists of the
+        behaviors, starting from the shortest.
+    */
+    virtual std::vector<SH>
+    getSubjectsWithAllBehaviors(const std::vector<BH> & behs,
+                                SH maxSubject = SH::max()) const;
+
+    /** Return the sorted subjects that have any of the given behaviors. */
+    virtual std::vector<SH>
+    getSubjectsWithAnyBehavior(const std::vector<BH> & behs,
+                               SH maxSubject = SH::max()) const;
+
+    /** Return the sorted subjects that had the given behavior at least
+        once at a time in [earliest, latest).  Default looks at all of the
+        timestamps of every subject with the behavior; domains saved with
+        a time index answer it from there.
+    */
+    virtual std::vector<SH>
+    getSubjectsWithBehaviorBetween(BH beh, Date earliest, Date latest,
+                                   SH maxSubject = SH::max()) const;
+
     std::vector<SH>
     getSubjectHashesFromHash(BH beh, SH maxSubject = SH(-1),
                              bool sorted = false) const
@@ -1000,6 +1022,13 @@ struct BehaviorDomain {
     int minSubjects;
     double timeQuantum;
     bool hasSubjectIds;
+
+    /** Width in seconds of the buckets of the time index that serialize()
+        writes, for example 86400 for one bucket per day.  The index lists
+        the subjects that had each behavior in each bucket.  Zero, the
+        default, writes no time index.
+    */
+    double timeIndexBucketSeconds;
 };
 
 std::ostream &
@@ -36,6 +36,7 @@
 #include "mldb/base/scope.h"
 
 #include "mapped_behavior_domain.h"
+#include "lazy_remote_file.h"
 #include "merged_behavior_domain.h"
 #include "mutable_behavior_domain.h"
 #include "behavior_svd.h"
@@ -120,7 +121,10 @@ namespace MLDB {
 
 BehaviorManager::
 BehaviorManager()
-    : cacheLoadedFiles(false), touchPages(true)
+    : cacheLoadedFiles(false), touchPages(true),
+      lazyRemoteLoading(false),
+      lazyRemoteChunkSize(LazyRemoteFile::DEFAULT_CHUNK_SIZE),
+      lazyRemotePrefetchChunks(LazyRemoteFile::DEFAULT_PREFETCH_CHUNKS)
 {
 }
 
@@ -815,6 +819,15 @@ getRemote(const std::string & filename,
         }
     }
 
+    // Compressed files can't be read from the middle, so they are always
+    // downloaded in full
+    if (lazyRemoteLoading
+        && !MLDB::endsWith(filename, ".gz")
+        && !MLDB::endsWith(filename, ".lz4")) {
+        return getRemoteLazy(filename, objectInfo,
+                             useCache ? cacheFile + ".lazy" : "");
+    }
+
     Date start = Date::now();
 
     bool cancelled = false;
@@ -871,6 +884,30 @@ getRemote(const std::string & filename,
     return result;
 }
 
+std::shared_ptr<BehaviorDomain>
+BehaviorManager::
+getRemoteLazy(const std::string & filename,
+              const FsObjectInfo & objectInfo,
+              const std::string & cacheFile)
+{
+    auto remote = std::make_shared<LazyRemoteFile>
+        (filename, objectInfo.size, cacheFile,
+         lazyRemoteChunkSize, lazyRemotePrefetchChunks);
+
+    if (!cacheFile.empty())
+        touchATime(cacheFile);
+
+    auto result = std::make_shared<MappedBehaviorDomain>(remote->buffer(),
+                                                         remote);
+
+    cerr << MLDB::format("beh mgr: opened %s lazily, downloaded %.3fMB of "
+                         "%.3fMB\n", filename.c_str(),
+                         remote->bytesDownloaded() / 1000000.0,
+                         objectInfo.size / 1000000.0);
+
+    return result;
+}
+
 std::shared_ptr<BehaviorDomain>
 BehaviorManager::
 getFile(const std::string & filename,
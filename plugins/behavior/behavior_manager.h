@@ -27,6 +27,7 @@ namespace MLDB {
 
 
 class BehaviorSvd;
+struct FsObjectInfo;
 
 
 /****************************************************************************/
@@ -190,6 +191,17 @@ struct BehaviorManager {
     bool cacheLoadedFiles;
     bool touchPages;
 
+    /** If this is true, uncompressed remote files are not downloaded before
+        they are opened.  Instead they are mapped through a sparse file in
+        the remote cache directory (or a temporary file if there is none),
+        and the parts of them that are accessed are downloaded in chunks of
+        lazyRemoteChunkSize bytes.  Sequential accesses cause the next
+        lazyRemotePrefetchChunks chunks to be downloaded in the background.
+    */
+    bool lazyRemoteLoading;
+    size_t lazyRemoteChunkSize;
+    int lazyRemotePrefetchChunks;
+
     mutable std::mutex lock;
     int shutdown;
     std::list<std::pair<MLDB::File_Read_Buffer, std::string> > writebackQueue;
@@ -208,6 +220,13 @@ private:
     std::vector<RemoteCacheEntry> getRemoteRecoverableEntries(uint64_t objectSize) const;
     bool recoverRemoteCacheDiskSpace(uint64_t objectSize) const;
 
+    /* Open the given remote file so that it's downloaded as it's read.
+       See lazyRemoteLoading. */
+    std::shared_ptr<BehaviorDomain>
+    getRemoteLazy(const std::string & filename,
+                  const FsObjectInfo & objectInfo,
+                  const std::string & cacheFile);
+
     std::string readFile(const std::string & filename,
                          std::function<bool (uint64_t)> onProgress) const;
 
@@ -23,6 +23,7 @@
 #include "mldb/types/jml_serialization.h"
 #include "mldb/base/scope.h"
 #include <mutex>
+#include <random>
 #include <thread>
 #include <unordered_map>
 
@@ -30,8 +31,6 @@
 using namespace std;
 namespace MLDB {
 
-extern __thread bool debugMergedBehaviors;
-
 /*****************************************************************************/
 /* BEHAVIOR SVD                                                             */
 /*****************************************************************************/
@@ -46,12 +45,14 @@ BehaviorSvd(SH maxSubject, int numDenseBehaviors,
       numDenseBehaviors(numDenseBehaviors),
       numSingularValues(numSingularValues),
       biasedBehaviors(biasedBehaviors.begin(), biasedBehaviors.end()),
-      space(space), calcLongTail(calcLongTail)
+      space(space), calcLongTail(calcLongTail), randomized(false),
+      oversampling(10), powerIterations(2), randomSeed(1)
 {
 }
 
 BehaviorSvd::
 BehaviorSvd(const std::string & filename)
+    : BehaviorSvd()
 {
     load(filename);
 }
@@ -171,15 +172,23 @@ train(const BehaviorDomain & behs,
     if (!finishedPhase("updateBehaviorCache"))
         return;
 
-    calcDenseCointersections(behs, cache);
+    if (randomized) {
+        calcDenseSvdRandomized(cache);
 
-    if (!finishedPhase("denseCointersections"))
-        return;
+        if (!finishedPhase("denseSvdRandomized"))
+            return;
+    }
+    else {
+        calcDenseCointersections(behs, cache);
 
-    calcDenseSvd();
+        if (!finishedPhase("denseCointersections"))
+            return;
 
-    if (!finishedPhase("denseSvd"))
-        return;
+        calcDenseSvd();
+
+        if (!finishedPhase("denseSvd"))
+            return;
+    }
 
     calcLongTailVectors(behs, cache);
 
@@ -373,6 +382,7 @@ updateBehaviorCache(const BehaviorDomain & behs,
     int index = 0;
     for (auto & s: subjects)
         indexes[s] = ++index;
+    cache.numRows = subjects.size();
 
 
     if (space != HAMMING) {
@@ -664,6 +674,290 @@ calcDenseSvd()
     ExcAssertEqual(denseBehaviors.size(), numDenseBehaviors);
 }
 
+namespace {
+
+/// Memory that the subject blocks of multiplyThroughSubjects may use at once
+constexpr size_t SUBJECT_BLOCK_MEMORY = 1ULL << 32;
+
+constexpr uint32_t NO_ROW = -1;
+
+/** Orthonormalize the columns of the numRows x numCols row-major matrix,
+    with classical Gram-Schmidt done twice, which is as stable as the
+    modified version but makes one pass over the rows per column.
+    Columns that are dependent on the previous ones are set to zero.
+*/
+void orthonormalizeColumns(std::vector<double> & m,
+                           size_t numRows, int numCols)
+{
+    std::vector<double> coeffs(numCols);
+
+    for (int c = 0;  c < numCols;  ++c) {
+        for (int pass = 0;  pass < 2;  ++pass) {
+            std::fill(coeffs.begin(), coeffs.begin() + c, 0.0);
+            for (size_t r = 0;  r < numRows;  ++r) {
+                const double * row = &m[r * numCols];
+                for (int p = 0;  p < c;  ++p)
+                    coeffs[p] += row[p] * row[c];
+            }
+            for (size_t r = 0;  r < numRows;  ++r) {
+                double * row = &m[r * numCols];
+                for (int p = 0;  p < c;  ++p)
+                    row[c] -= coeffs[p] * row[p];
+            }
+        }
+
+        double norm = 0.0;
+        for (size_t r = 0;  r < numRows;  ++r)
+            norm += m[r * numCols + c] * m[r * numCols + c];
+        norm = sqrt(norm);
+
+        double scale = norm > 1e-10 ? 1.0 / norm : 0.0;
+        for (size_t r = 0;  r < numRows;  ++r)
+            m[r * numCols + c] *= scale;
+    }
+}
+
+} // file scope
+
+std::vector<float>
+BehaviorSvd::
+multiplyThroughSubjects(const BehaviorCache & cache,
+                        const std::vector<BH> & inBehaviors,
+                        const double * x, int numCols,
+                        const std::vector<BH> & outBehaviors) const
+{
+    auto getEntry = [&] (BH beh) -> const IntersectionEntry *
+        {
+            if (biasedBehaviors.count(beh))
+                return nullptr;
+            auto it = cache.behToIndex.find(beh);
+            if (it == cache.behToIndex.end())
+                return nullptr;
+            return &cache.subjects[it->second];
+        };
+
+    std::vector<const IntersectionEntry *> in, out;
+    in.reserve(inBehaviors.size());
+    for (BH beh: inBehaviors)
+        in.push_back(getEntry(beh));
+    out.reserve(outBehaviors.size());
+    for (BH beh: outBehaviors)
+        out.push_back(getEntry(beh));
+
+    bool weighted = space != HAMMING;
+
+    constexpr int NUM_BUCKETS
+        = sizeof(IntersectionEntry::buckets)
+        / sizeof(IntersectionEntry::buckets[0]);
+
+    // Position of each subject row within its bucket's block.  A subject
+    // is in the same bucket for every behavior, so blocks that are built
+    // at the same time write to different entries.
+    std::vector<uint32_t> rowLocal(cache.numRows + 1, NO_ROW);
+
+    // Rows of A_in X for the subjects of a bucket that have at least one
+    // of the input behaviors
+    struct Block {
+        std::vector<uint32_t> rows;
+        std::vector<float> values;
+    };
+
+    auto buildBlock = [&] (int b, Block & block)
+        {
+            for (auto e: in) {
+                if (!e)
+                    continue;
+                auto & rows = e->buckets[b].rows;
+                block.rows.insert(block.rows.end(), rows.begin(), rows.end());
+            }
+
+            std::sort(block.rows.begin(), block.rows.end());
+            block.rows.erase(std::unique(block.rows.begin(), block.rows.end()),
+                             block.rows.end());
+
+            for (size_t i = 0;  i < block.rows.size();  ++i)
+                rowLocal.at(block.rows[i]) = i;
+
+            block.values.resize(block.rows.size() * numCols);
+
+            for (size_t j = 0;  j < in.size();  ++j) {
+                if (!in[j])
+                    continue;
+                const IntersectionEntry::Bucket & bucket = in[j]->buckets[b];
+                bool useCounts = weighted && !bucket.counts.empty();
+                const double * xj = x + j * numCols;
+
+                for (size_t i = 0;  i < bucket.rows.size();  ++i) {
+                    float w = useCounts ? bucket.counts[i] : 1.0f;
+                    float * u = &block.values[rowLocal[bucket.rows[i]]
+                                              * (size_t)numCols];
+                    for (int c = 0;  c < numCols;  ++c)
+                        u[c] += w * xj[c];
+                }
+            }
+        };
+
+    // Do as many buckets at once as fit in memory
+    size_t rowsPerBucket = cache.numRows / NUM_BUCKETS + 1;
+    int bucketsPerGroup
+        = std::max<size_t>(1, std::min<size_t>(NUM_BUCKETS,
+                                               SUBJECT_BLOCK_MEMORY
+                                               / sizeof(float)
+                                               / (rowsPerBucket * numCols)));
+
+    std::vector<float> result(out.size() * numCols);
+
+    for (int first = 0;  first < NUM_BUCKETS;  first += bucketsPerGroup) {
+        int last = std::min(NUM_BUCKETS, first + bucketsPerGroup);
+
+        std::vector<Block> blocks(last - first);
+        parallelMap(first, last,
+                    [&] (size_t b) { buildBlock(b, blocks[b - first]); });
+
+        auto accumulate = [&] (size_t begin, size_t end)
+            {
+                std::vector<double> acc(numCols);
+
+                for (size_t o = begin;  o < end;  ++o) {
+                    if (!out[o])
+                        continue;
+
+                    std::fill(acc.begin(), acc.end(), 0.0);
+
+                    for (int b = first;  b < last;  ++b) {
+                        const IntersectionEntry::Bucket & bucket
+                            = out[o]->buckets[b];
+                        const Block & block = blocks[b - first];
+                        bool useCounts = weighted && !bucket.counts.empty();
+
+                        for (size_t i = 0;  i < bucket.rows.size();  ++i) {
+                            uint32_t local = rowLocal[bucket.rows[i]];
+                            if (local == NO_ROW)
+                                continue;  // no input behaviors
+                            double w = useCounts ? bucket.counts[i] : 1.0;
+                            const float * u
+                                = &block.values[local * (size_t)numCols];
+                            for (int c = 0;  c < numCols;  ++c)
+                                acc[c] += w * u[c];
+                        }
+                    }
+
+                    float * r = &result[o * numCols];
+                    for (int c = 0;  c < numCols;  ++c)
+                        r[c] += acc[c];
+                }
+            };
+
+        parallelMapChunked(0, out.size(), 256, accumulate);
+    }
+
+    return result;
+}
+
+void
+BehaviorSvd::
+calcDenseSvdRandomized(const BehaviorCache & cache)
+{
+    int n = numDenseBehaviors;
+    if (numSingularValues > n)
+        throw MLDB::Exception("more singular values than dense behaviors");
+
+    // Number of vectors sampled
+    int l = std::min(n, numSingularValues + oversampling);
+
+    // Multiply by B = A^T A over the dense behaviors
+    auto multiplyB = [&] (const std::vector<double> & q)
+        {
+            std::vector<float> result
+                = multiplyThroughSubjects(cache, denseBehaviors, q.data(), l,
+                                          denseBehaviors);
+            return std::vector<double>(result.begin(), result.end());
+        };
+
+    // Find an orthonormal basis Q for the range of B
+    std::mt19937 rng(randomSeed);
+    std::normal_distribution<double> normal;
+    std::vector<double> q(n * (size_t)l);
+    for (auto & v: q)
+        v = normal(rng);
+
+    q = multiplyB(q);
+    orthonormalizeColumns(q, n, l);
+
+    for (int i = 0;  i < powerIterations;  ++i) {
+        q = multiplyB(q);
+        orthonormalizeColumns(q, n, l);
+    }
+
+    // Project B into it: T = Q^T B Q is only l x l
+    std::vector<double> bq = multiplyB(q);
+    std::vector<double> t(l * l);
+
+    auto calcRow = [&] (size_t i)
+        {
+            for (size_t r = 0;  r < n;  ++r) {
+                double qri = q[r * l + i];
+                for (int j = 0;  j < l;  ++j)
+                    t[i * l + j] += qri * bq[r * l + j];
+            }
+        };
+
+    parallelMap(0, l, calcRow);
+
+    for (int i = 0;  i < l;  ++i) {
+        for (int j = 0;  j < i;  ++j) {
+            t[i * l + j] = t[j * l + i]
+                = 0.5 * (t[i * l + j] + t[j * l + i]);
+        }
+    }
+
+    auto opb_fn = [&] (double *x, double *y)
+    {
+        for (int i = 0;  i < l;  ++i) {
+            double yval = 0.0;
+            for (int j = 0;  j < l;  ++j)
+                yval += t[i * l + j] * x[j];
+            y[i] = yval;
+        }
+    };
+
+    SVDParams params;
+    params.opb = opb_fn;
+    params.ierr = 0;
+    params.nrows = l;
+    params.ncols = l;
+    params.nvals = 0;
+    params.doU = false;
+    params.calcPrecision(params.ncols);
+
+    svdrec * svdResult = svdLAS2A(numSingularValues, params);
+    Scope_Exit(svdFreeSVDRec(svdResult));
+
+    int d = std::min(svdResult->d, numSingularValues);
+
+    singularValues.clear();
+    singularValues.resize(numSingularValues);
+    std::copy(svdResult->S, svdResult->S + d, singularValues.begin());
+
+    cerr << "svalues = " << singularValues << endl;
+
+    // The dense singular vectors are Q times those of T
+    denseVectors.clear();
+    denseVectors.resize(n, distribution<float>(numSingularValues));
+
+    auto calcDenseVector = [&] (size_t r)
+        {
+            for (int v = 0;  v < d;  ++v) {
+                double total = 0.0;
+                for (int i = 0;  i < l;  ++i)
+                    total += q[r * l + i] * svdResult->Vt->value[v][i];
+                denseVectors[r][v] = total;
+            }
+        };
+
+    parallelMap(0, n, calcDenseVector);
+}
+
 distribution<float>
 BehaviorSvd::
 calculateBehaviorVectorCached(BH beh, const BehaviorDomain & behs,
@@ -818,177 +1112,52 @@ BehaviorSvd::
 calcLongTailVectors(const BehaviorDomain & behs,
                     const BehaviorCache & cache)
 {
-    cerr << "calculating long-tail vectors for "
-         << sparseBehaviors.size() << " behaviors" << endl;
-
-    if (!shortCircuit) {
-        // This test fails when short circuiting, as we don't calculate the
-        // values exactly.
+    vector<BH> behaviors = denseBehaviors;
+    if (calcLongTail)
+        behaviors.insert(behaviors.end(),
+                         sparseBehaviors.begin(), sparseBehaviors.end());
 
-        cerr << "vector for dense beh 0 = " << denseBehaviors[0] << endl;
-        cerr << denseVectors[0] << endl;
-        distribution<float> v = calculateBehaviorVectorCached(denseBehaviors[0], behs, cache);
-        distribution<float> v2 = calculateBehaviorVector(denseBehaviors[0], behs);
+    cerr << "calculating vectors for " << behaviors.size() << " behaviors"
+         << endl;
 
-        cerr << "v = " << v << endl;
-        cerr << "v2 = " << v2 << endl;
-        cerr << "v - v2 = " << v - v2 << endl;
+    // The vector of a behavior is the sum of the dense vectors weighted by
+    // its overlap with each dense behavior, which is A_beh^T A_dense V.
+    // The overlaps are never calculated; the products are taken through
+    // the subjects instead.
+    int k = numSingularValues;
+    vector<double> dense(denseVectors.size() * k);
+    for (unsigned i = 0;  i < denseVectors.size();  ++i)
+        std::copy(denseVectors[i].begin(), denseVectors[i].end(),
+                  dense.begin() + i * k);
 
-        ExcAssertEqual(abs(v - v2).total(), 0.0);
-
-        cerr << "reconstructed = "
-             << v << " two_norm = " << v.two_norm()
-             << endl;
-    }
+    vector<float> projected
+        = multiplyThroughSubjects(cache, denseBehaviors, dense.data(), k,
+                                  behaviors);
 
     std::atomic<uint64_t> numZeros(0);
 
-    auto calcAndCheckBehavior = [&] (BH beh)
+    auto setVector = [&] (size_t i)
         {
-            auto it = behaviorIndex.find(beh);
+            auto it = behaviorIndex.find(behaviors[i]);
             if (it == behaviorIndex.end())
                 throw MLDB::Exception("couldn't find behavior");
-            int i = it->second;
 
-            distribution<float> v = this->calculateBehaviorVectorCached(beh, behs, cache);
-            singularVectors[i] = v;
+            distribution<float> v(k);
+            for (int j = 0;  j < k;  ++j) {
+                double sv = singularValues[j];
+                if (sv != 0.0)
+                    v[j] = projected[i * k + j] / (sv * sv);
+            }
 
             if (v.two_norm() == 0)
                 numZeros += 1;
 
-            if (v.two_norm() == 0 && false) {
-                static std::mutex mutex;
-                mutex.lock();
-
-                debugMergedBehaviors = true;
-
-                static std::map<BH, int> denseSet;
-                if (denseSet.empty()) {
-                    for (unsigned i = 0;  i < denseBehaviors.size();
-                         ++i) {
-                        denseSet[denseBehaviors[i]] = i;
-                    }
-                }
-                
-#if 0
-                BehaviorDomain::BehaviorStats st
-                    = behs.getBehaviorStats(beh);
-                cerr << "beh = " << beh << " two_norm = " << v.two_norm()
-                     << " count " << st.count << " subjects "
-                     << st.subjectCount
-                     << endl;
-#endif
-
-                auto subj = behs.getSubjectHashes(beh, maxSubject, false);
-
-                for (auto it = subj.begin(), end = subj.end();
-                     it != end;  ++it) {
-
-                    SH sh(*it);
-
-                    if (sh > maxSubject) continue;
-
-                    auto sbehs = behs.getSubjectBehaviorCounts(sh);
-
-                    cerr << "  subject " << sh << " has "
-                         << sbehs.size() << " behaviors: " << endl;
-
-                    for (unsigned i = 0;   i < sbehs.size();  ++i) {
-                        cerr << "    " << i << " " << sbehs[i].first
-                             << " --> " << sbehs[i].second;
-                        int index = -1;
-                        auto jt = denseSet.find(sbehs[i].first);
-                        if (jt != denseSet.end()) {
-                            index = jt->second;
-                            cerr << " *** (" << index << ")";
-                                
-                            float ol
-                                = this->calcOverlap(beh, denseBehaviors[index],
-                                                    behs);
-                            cerr << " ol = " << ol;
-
-                            std::vector<SH> subj1
-                                = behs.getSubjectHashes(beh, maxSubject,
-                                                        true);
-                            std::vector<SH> subj2
-                                = behs.getSubjectHashes(denseBehaviors[index],
-                                                        maxSubject, true);
-
-                            std::set<SH> allSubjects;
-                            std::set_intersection(subj1.begin(),
-                                                  subj1.end(),
-                                                  subj2.begin(),
-                                                  subj2.end(),
-                                                  inserter(allSubjects,
-                                                           allSubjects.end()));
-                            cerr << " int = " << allSubjects.size(); 
-                            cerr << " cnt = " << allSubjects.count(sh);
-                        }
-                        cerr << endl;
-                    }
-                }
-
-                debugMergedBehaviors = false;
-                mutex.unlock();
-            }
-
-            return v;
-        };
-
-    Date denseStart = Date::now();
-    Date lastDense = denseStart;
-    
-    auto calcDenseBehavior = [&] (int i)
-        {
-            BH beh = denseBehaviors[i];
-            auto v = calcAndCheckBehavior(beh);
-
-            if (i % 100 == 0) {
-                cerr << "i = " << i << " beh = " << beh
-                     << " two_norm = " << v.two_norm() << " "
-                     << (i / Date::now().secondsSince(denseStart))
-                     << "/s (o) "
-                     << (100 / Date::now().secondsSince(lastDense))
-                     << "/s (i) "
-                     << endl;
-                lastDense = Date::now();
-            }
-        };
-
-    cerr << "done dense behaviors" << endl;
-
-    parallelMap(0, denseBehaviors.size(),
-                             calcDenseBehavior);
-
-    if (!calcLongTail)
-        return;
-
-    Date sparseStart = Date::now();
-    Date lastSparse = sparseStart;
-
-    auto calcSparseBehavior = [&] (int i)
-        {
-            BH beh = sparseBehaviors[i];
-            auto v = calcAndCheckBehavior(beh);
-
-            if (i % 1000000 == 0) {
-                cerr << "i = " << i << " beh = " << beh
-                     << " two_norm = " << v.two_norm() << " "
-                     << (i / Date::now().secondsSince(sparseStart))
-                     << "/s (o) "
-                     << (1000 / Date::now().secondsSince(lastSparse))
-                     << "/s (i) "
-                     << endl;
-                lastSparse = Date::now();
-            }
+            singularVectors[it->second] = std::move(v);
         };
 
-    cerr << "done sparse behaviors" << endl;
+    parallelMap(0, behaviors.size(), setVector);
 
-    parallelMap(0, sparseBehaviors.size(),
-                             calcSparseBehavior);
-    cerr << numZeros << " of " << sparseBehaviors.size() << " are zero"
-         << endl;
+    cerr << numZeros << " of " << behaviors.size() << " are zero" << endl;
 }
 
 std::pair<std::vector<std::pair<BH, float> >,
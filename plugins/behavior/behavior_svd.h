@@ -28,7 +28,8 @@ namespace MLDB {
 struct BehaviorSvd {
 
     BehaviorSvd()
-        : space(HAMMING), calcLongTail(true)
+        : space(HAMMING), calcLongTail(true), randomized(false),
+          oversampling(10), powerIterations(2), randomSeed(1)
     {
     }
 
@@ -52,6 +53,17 @@ struct BehaviorSvd {
     IntersectionSpace space;
     bool calcLongTail;
 
+    /** Calculate the SVD of the dense behaviors with a randomized range
+        finder, which multiplies blocks of vectors through the subjects of
+        the dense behaviors, rather than with Lanczos over the matrix of
+        overlaps between every two dense behaviors.  This scales to many
+        more dense behaviors.
+    */
+    bool randomized;
+    int oversampling;      ///< Extra dimensions sampled by the range finder
+    int powerIterations;   ///< Power iterations of the range finder
+    uint32_t randomSeed;   ///< Seed for the range finder's random vectors
+
     /** Singular values */
     distribution<float> singularValues;
 
@@ -153,18 +165,41 @@ struct BehaviorSvd {
         std::vector<BH> behaviors;
         std::vector<IntersectionEntry> subjects;
         LightweightHash<BH, int> behToIndex;
+        size_t numRows = 0;  ///< Subject rows are numbered from 1 to this
     };
 
     void updateBehaviorCache(const BehaviorDomain & behs,
                               SH maxSubject,
                               BehaviorCache & cache) const;
 
-    /** Run over all sparse vectors and call calcBehaviorVector to complete
-        the SVD.
+    /** Calculate the singular vectors of all of the behaviors (or only
+        the dense ones if calcLongTail is false) by projecting them onto
+        the dense singular vectors, to complete the SVD.
     */
     void calcLongTailVectors(const BehaviorDomain & behs,
                              const BehaviorCache & cache);
 
+    /** Return A_out^T (A_in X), where A_in and A_out are the subject by
+        behavior matrices (in the SVD's space) of the input and output
+        behaviors, and X has numCols columns and a row for each input
+        behavior.  The result has a row for each output behavior.
+
+        The subjects are processed in blocks of the cache's subject
+        buckets: the rows of A_in X for a block are calculated and then
+        multiplied into all of the output behaviors, in parallel.  Biased
+        behaviors and those not in the cache count as empty.
+    */
+    std::vector<float>
+    multiplyThroughSubjects(const BehaviorCache & cache,
+                            const std::vector<BH> & inBehaviors,
+                            const double * x, int numCols,
+                            const std::vector<BH> & outBehaviors) const;
+
+    /** Calculate the dense singular values and vectors with a randomized
+        range finder; see randomized.
+    */
+    void calcDenseSvdRandomized(const BehaviorCache & cache);
+
 
     
     /** Create the cointersection matrix (A^TA) required for the SVD.  This
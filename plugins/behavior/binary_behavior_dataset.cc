@@ -659,6 +659,7 @@ commit()
         MLDB::makeUriDirectory(address);
         itl->mutableBehs->save(address);
     }
+    dataChanged();
 }
 
 namespace {
@@ -58,6 +58,10 @@ BehaviorWrapper(const BehaviorDomain & behs)
         = std::bind(mem_fn(&BehaviorDomain::getSubjectHashesAndAllTimestamps),
                     this->behs, _1, _2, true /* sorted */);
 
+    getSubjectHashes
+        = std::bind(mem_fn(&BehaviorDomain::getSubjectHashes),
+                    this->behs, _1, _2, true /* sorted */);
+
     getBehaviorsContainingString = [=] (const std::string & mustContain)
         {
             std::vector<Id> segmentsMatching;
@@ -305,6 +309,70 @@ filter_after_within(const BehaviorWrapper & behs,
     return doIntersection(input, generate(behs, maxSubject), accept, pickDate);
 }
 
+/** Subject bitmaps are processed in parallel over tranches of this many
+    consecutive subjects of the universe.  It's a multiple of 64 so that
+    no word of the bitmap is shared between two tranches.
+*/
+static constexpr size_t SUBJECT_BITMAP_TRANCHE_SIZE = 64 * 4096;
+
+/** Call fn(beginWord, endWord) in parallel for each tranche of a bitmap
+    over the given number of subjects.
+*/
+template<typename Fn>
+static void forEachBitmapTranche(size_t numSubjects, const Fn & fn)
+{
+    size_t numWords = (numSubjects + 63) / 64;
+    size_t wordsPerTranche = SUBJECT_BITMAP_TRANCHE_SIZE / 64;
+    size_t numTranches = (numWords + wordsPerTranche - 1) / wordsPerTranche;
+
+    auto onTranche = [&] (size_t t)
+        {
+            size_t beginWord = t * wordsPerTranche;
+            size_t endWord = std::min(numWords, beginWord + wordsPerTranche);
+            fn(beginWord, endWord);
+        };
+
+    parallelMap(0, numTranches, onTranche);
+}
+
+std::vector<uint64_t>
+BooleanExpression::
+generateSubjectBitmap(const BehaviorWrapper & behs,
+                      const std::vector<SH> & universe) const
+{
+    throw MLDB::Exception("Expression " + print() + " depends on timestamps "
+                          "and can't be evaluated as a subject bitmap");
+}
+
+size_t
+BooleanExpression::
+countSubjects(const BehaviorWrapper & behs, SH maxSubject) const
+{
+    if (!isSetExpression()) {
+        auto gen = generate(behs, maxSubject);
+        std::sort(gen.begin(), gen.end(), CompareSubjects());
+        return std::unique(gen.begin(), gen.end(),
+                           [] (const std::pair<SH, Date> & p1,
+                               const std::pair<SH, Date> & p2)
+                           {
+                               return p1.first == p2.first;
+                           })
+            - gen.begin();
+    }
+
+    std::vector<SH> universe = behs.allSubjectHashes(maxSubject);
+    universe.erase(std::upper_bound(universe.begin(), universe.end(),
+                                    maxSubject),
+                   universe.end());
+
+    std::vector<uint64_t> bitmap = generateSubjectBitmap(behs, universe);
+
+    size_t result = 0;
+    for (uint64_t w: bitmap)
+        result += __builtin_popcountll(w);
+    return result;
+}
+
 /*****************************************************************************/
 /* SEG EXPRESSION                                                            */
 /*****************************************************************************/
@@ -345,6 +413,51 @@ generateAllTimestamps(const BehaviorWrapper & behs,
     return behs.getSubjectHashesAndAllTimestamps(seg, maxSubject);
 }
 
+std::vector<uint64_t>
+SegExpression::
+generateSubjectBitmap(const BehaviorWrapper & behs,
+                      const std::vector<SH> & universe) const
+{
+    std::vector<uint64_t> result((universe.size() + 63) / 64);
+    if (universe.empty())
+        return result;
+
+    std::vector<SH> subjects;
+    if (behs.getSubjectHashes) {
+        subjects = behs.getSubjectHashes(seg, universe.back());
+    }
+    else {
+        for (auto & s: behs.getSubjectHashesAndTimestamps(seg, universe.back()))
+            subjects.push_back(s.first);
+    }
+
+    // Each tranche looks up the segment's subjects that fall within its
+    // range of the universe.  Segments are normally much smaller than the
+    // universe, so we binary search rather than walking the universe.
+    auto onTranche = [&] (size_t beginWord, size_t endWord)
+        {
+            auto ubegin = universe.begin() + beginWord * 64;
+            auto uend = universe.begin()
+                + std::min(universe.size(), endWord * 64);
+            auto it = std::lower_bound(subjects.begin(), subjects.end(),
+                                       *ubegin);
+            auto u = ubegin;
+            for (;  it != subjects.end() && *it <= uend[-1];  ++it) {
+                u = std::lower_bound(u, uend, *it);
+                if (u == uend)
+                    break;
+                if (*u != *it)
+                    continue;
+                size_t i = u - universe.begin();
+                result[i / 64] |= uint64_t(1) << (i % 64);
+            }
+        };
+
+    forEachBitmapTranche(universe.size(), onTranche);
+
+    return result;
+}
+
 
 /*****************************************************************************/
 /* CONTAINS EXPRESSION                                                       */
@@ -628,6 +741,28 @@ generateAllTimestamps(const BehaviorWrapper & behs, SH maxSubject) const
     return generate(behs, maxSubject);
 }
 
+std::vector<uint64_t>
+NotExpression::
+generateSubjectBitmap(const BehaviorWrapper & behs,
+                      const std::vector<SH> & universe) const
+{
+    std::vector<uint64_t> result = base->generateSubjectBitmap(behs, universe);
+
+    auto onTranche = [&] (size_t beginWord, size_t endWord)
+        {
+            for (size_t i = beginWord;  i < endWord;  ++i)
+                result[i] = ~result[i];
+        };
+
+    forEachBitmapTranche(universe.size(), onTranche);
+
+    // Clear the bits past the end of the universe
+    if (universe.size() % 64)
+        result.back() &= (uint64_t(1) << (universe.size() % 64)) - 1;
+
+    return result;
+}
+
 BoolExprPtr 
 NotExpression::
 bind(const BehaviorWrapper & behs,
@@ -698,6 +833,33 @@ generateAllTimestamps(const BehaviorWrapper & behs, SH maxSubject) const
                         "not done");
 }
 
+std::vector<uint64_t>
+AndExpression::
+generateSubjectBitmap(const BehaviorWrapper & behs,
+                      const std::vector<SH> & universe) const
+{
+    if (exprs.empty())
+        return std::vector<uint64_t>((universe.size() + 63) / 64);
+
+    std::vector<uint64_t> result
+        = exprs[0]->generateSubjectBitmap(behs, universe);
+
+    for (unsigned i = 1;  i < exprs.size();  ++i) {
+        std::vector<uint64_t> other
+            = exprs[i]->generateSubjectBitmap(behs, universe);
+
+        auto onTranche = [&] (size_t beginWord, size_t endWord)
+            {
+                for (size_t j = beginWord;  j < endWord;  ++j)
+                    result[j] &= other[j];
+            };
+
+        forEachBitmapTranche(universe.size(), onTranche);
+    }
+
+    return result;
+}
+
 
 /*****************************************************************************/
 /* OR EXPRESSION                                                             */
@@ -750,6 +912,26 @@ generateAllTimestamps(const BehaviorWrapper & behs, SH maxSubject) const
     return result;
 }
 
+std::vector<uint64_t>
+OrExpression::
+generateSubjectBitmap(const BehaviorWrapper & behs,
+                      const std::vector<SH> & universe) const
+{
+    std::vector<uint64_t> result((universe.size() + 63) / 64);
+    mutex m;
+
+    auto mainWork = [&](size_t it){
+        std::vector<uint64_t> tmpResult
+            = exprs[it]->generateSubjectBitmap(behs, universe);
+        unique_lock<mutex> lock(m);
+        for (size_t i = 0;  i < result.size();  ++i)
+            result[i] |= tmpResult[i];
+    };
+    parallelMap(0, exprs.size(), mainWork);
+
+    return result;
+}
+
 
 /*****************************************************************************/
 /* THEN EXPRESSION                                                           */
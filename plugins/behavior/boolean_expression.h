@@ -37,6 +37,11 @@ struct BehaviorWrapper {
     std::function<std::vector<std::pair<SH, Date> > (BH beh, SH maxSubject)>
     getSubjectHashesAndTimestamps;
 
+    /// Sorted subjects of the behavior.  Optional; if not set, the subjects
+    /// are taken from getSubjectHashesAndTimestamps.
+    std::function<std::vector<SH>(BH beh, SH maxSubject)>
+    getSubjectHashes;
+
     std::function<std::vector<std::pair<SH, Date> > (BH beh, SH maxSubject)>
     getSubjectHashesAndAllTimestamps;
 
@@ -156,6 +161,31 @@ struct BooleanExpression {
     filter_after_within(const BehaviorWrapper & behs,
            const std::vector<std::pair<SH, Date> > & input,
            unsigned within) const;
+
+    /** Does this expression only depend on which subjects have which
+        behaviors, and not on when?  Those that do can be evaluated as
+        bitmaps by generateSubjectBitmap().  Default says no.
+    */
+    virtual bool isSetExpression() const
+    {
+        return false;
+    }
+
+    /** Evaluate the expression over the given sorted universe of subjects,
+        returning a bitmap where bit i is set if and only if universe[i]
+        matches.  The universe must contain every subject that could
+        match.  Only supported where isSetExpression() is true.
+    */
+    virtual std::vector<uint64_t>
+    generateSubjectBitmap(const BehaviorWrapper & behs,
+                          const std::vector<SH> & universe) const;
+
+    /** Return the number of distinct matching subjects up to maxSubject.
+        Set expressions are counted using bitmaps; anything that depends
+        on timestamps falls back to generate().
+    */
+    size_t countSubjects(const BehaviorWrapper & behs,
+                         SH maxSubject = SH::max()) const;
 };
 
 
@@ -189,6 +219,15 @@ struct SegExpression : public BooleanExpression {
     generateAllTimestamps(const BehaviorWrapper & behs,
                           SH maxSubject) const;
 
+    virtual bool isSetExpression() const
+    {
+        return true;
+    }
+
+    virtual std::vector<uint64_t>
+    generateSubjectBitmap(const BehaviorWrapper & behs,
+                          const std::vector<SH> & universe) const;
+
     Id seg;
 };
 
@@ -348,6 +387,15 @@ struct NotExpression : public BooleanExpression {
     generateAllTimestamps(const BehaviorWrapper & behs,
                           SH maxSubject) const;
 
+    virtual bool isSetExpression() const
+    {
+        return base->isSetExpression();
+    }
+
+    virtual std::vector<uint64_t>
+    generateSubjectBitmap(const BehaviorWrapper & behs,
+                          const std::vector<SH> & universe) const;
+
     BoolExprPtr base;
 
     virtual BoolExprPtr bind(const BehaviorWrapper & behs,
@@ -391,6 +439,15 @@ struct CompoundExpression : public BooleanExpression {
         return newExprs;
     }
 
+    /// Are all of the children set expressions?
+    bool allSetExpressions() const
+    {
+        for (auto & e: exprs)
+            if (!e->isSetExpression())
+                return false;
+        return true;
+    }
+
     std::string print_(bool isSql) const;
     virtual std::string print() const {return print_(false);}
     virtual std::string printSql() const {return print_(true);}
@@ -430,6 +487,15 @@ struct AndExpression : public CompoundExpression {
     virtual std::vector<std::pair<SH, Date> >
     filter(const BehaviorWrapper & behs,
            const std::vector<std::pair<SH, Date> > & input) const;
+
+    virtual bool isSetExpression() const
+    {
+        return allSetExpressions();
+    }
+
+    virtual std::vector<uint64_t>
+    generateSubjectBitmap(const BehaviorWrapper & behs,
+                          const std::vector<SH> & universe) const;
 };
 
 
@@ -456,6 +522,15 @@ struct OrExpression : public CompoundExpression {
     virtual std::vector<std::pair<SH, Date> >
     generateAllTimestamps(const BehaviorWrapper & behs,
                           SH maxSubject) const;
+
+    virtual bool isSetExpression() const
+    {
+        return allSetExpressions();
+    }
+
+    virtual std::vector<uint64_t>
+    generateSubjectBitmap(const BehaviorWrapper & behs,
+                          const std::vector<SH> & universe) const;
 };
 
 /*****************************************************************************/
@@ -183,6 +183,111 @@ inline int hexToDec2(int c)
     return v;
 }
 
+/* Helpers to validate and decode eight characters at a time.  The
+   characters are loaded into a 64 bit word with the first one in the low
+   order byte, and the per-character tests are done on all eight bytes at
+   once, leaving their answer in the high bit of each byte.  These only
+   work where every byte is ASCII, which the callers check first.
+*/
+
+static constexpr uint64_t LOW_BYTES = 0x0101010101010101ULL;
+static constexpr uint64_t HIGH_BITS = 0x8080808080808080ULL;
+
+static MLDB_ALWAYS_INLINE uint64_t loadChars8(const char * p)
+{
+    uint64_t result;
+    std::memcpy(&result, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    result = __builtin_bswap64(result);
+#endif
+    return result;
+}
+
+// High bit set in each byte of x that is >= c
+static MLDB_ALWAYS_INLINE uint64_t bytesAtLeast(uint64_t x, unsigned c)
+{
+    return ((x | HIGH_BITS) - c * LOW_BYTES) & HIGH_BITS;
+}
+
+// High bit set in each byte of x that is <= c
+static MLDB_ALWAYS_INLINE uint64_t bytesAtMost(uint64_t x, unsigned c)
+{
+    return ((c | 0x80) * LOW_BYTES - x) & HIGH_BITS;
+}
+
+/** Decode eight hex digits into their 32 bit value, or return -1 if any
+    of them isn't a hex digit.  sawLower and sawUpper are set if any of
+    them is a lowercase or uppercase letter.
+*/
+static MLDB_ALWAYS_INLINE int64_t
+decodeHex8(const char * p, bool & sawLower, bool & sawUpper)
+{
+    uint64_t x = loadChars8(p);
+    if (x & HIGH_BITS)
+        return -1;
+
+    uint64_t digits = bytesAtLeast(x, '0') & bytesAtMost(x, '9');
+    uint64_t lower = bytesAtLeast(x, 'a') & bytesAtMost(x, 'f');
+    uint64_t upper = bytesAtLeast(x, 'A') & bytesAtMost(x, 'F');
+    if ((digits | lower | upper) != HIGH_BITS)
+        return -1;
+    sawLower = sawLower || lower;
+    sawUpper = sawUpper || upper;
+
+    // Letters have 1-6 in their low nibble; adding 9 gives their value
+    uint64_t nibbles
+        = (x & (0x0f * LOW_BYTES)) + ((lower | upper) >> 7) * 9;
+
+    // Pack each pair of nibbles into a byte, the first being the high one,
+    // then gather the four bytes together
+    uint64_t bytes = ((nibbles & 0x000f000f000f000fULL) << 4)
+                   | ((nibbles & 0x0f000f000f000f00ULL) >> 8);
+    bytes = (bytes | (bytes >> 8)) & 0x0000ffff0000ffffULL;
+    bytes = (bytes | (bytes >> 16)) & 0xffffffffULL;
+
+    // The first characters are the most significant
+    return __builtin_bswap32(bytes);
+}
+
+/** Decode eight decimal digits into their value, or return -1 if any of
+    them isn't a digit.
+*/
+static MLDB_ALWAYS_INLINE int64_t decodeDec8(const char * p)
+{
+    uint64_t x = loadChars8(p);
+    if ((x & HIGH_BITS)
+        || (bytesAtLeast(x, '0') & bytesAtMost(x, '9')) != HIGH_BITS)
+        return -1;
+
+    x -= '0' * LOW_BYTES;
+    // Pairs, then quads, then all eight
+    x = (x * 10) + (x >> 8);
+    x = (((x & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32)))
+         + (((x >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32))))
+        >> 32;
+    return x;
+}
+
+/** Is the string made only of non-null ASCII characters?  Those are the
+    ones for which the UTF-8 validation done by the generic hashing path
+    can't fail.
+*/
+static bool isPlainAscii(const char * p, size_t len)
+{
+    size_t i = 0;
+    for (;  i + 8 <= len;  i += 8) {
+        uint64_t x = loadChars8(p + i);
+        // High bit set, or a zero byte
+        if ((x | ((x - LOW_BYTES) & ~x)) & HIGH_BITS)
+            return false;
+    }
+    for (;  i < len;  ++i) {
+        if (p[i] == 0 || (p[i] & 0x80))
+            return false;
+    }
+    return true;
+}
+
 Id::Id(const char * value, Type type)
     : type(NONE), val1(0), val2(0)
 {
@@ -246,60 +351,32 @@ parse(const char * value, size_t len, Type type)
         if (value[18] != '-') break;
         if (value[23] != '-') break;
 
-        unsigned f1;
-        short f2, f3, f4;
-        unsigned long long f5;
-
-        const char * p = value;
-        bool failed = false;
-        int capsType = -1; // -1 = unknown, 0 = no, 1 = yes
-
-        auto scanRange = [&] (int start, int len) -> unsigned long long
-            {
-                unsigned long long val = 0;
-                for (unsigned i = start;  i != start + len;  ++i) {
-                    int c = p[i];
-                    {
-                        // case handling
-                        if (c >= 'a' && c <= 'f') {
-                            if (capsType == -1) {
-                                capsType = 0;
-                            }
-                            else if (capsType != 0) {
-                                failed = true;
-                                return val;
-                            }
-                        }
-                        else if (c >= 'A' && c <= 'F') {
-                            if (capsType == -1) {
-                                capsType = 1;
-                            }
-                            else if (capsType != 1) {
-                                failed = true;
-                                return val;
-                            }
-                        }
-                    }
-                    int v = hexToDec(c);
-                    if (v == -1) {
-                        failed = true;
-                        return val;
-                    }
-                    val = (val << 4) + v;
-                }
-                return val;
-            };
-
-        f1 = scanRange(0, 8);
-        f2 = scanRange(9, 4);
-        f3 = scanRange(14, 4);
-        if (failed) break;
-        f4 = scanRange(19, 4);
-        f5 = scanRange(24, 12);
-        if (failed) break;
+        // Gather the 32 hex digits together and decode them eight at a
+        // time
+        char digits[32];
+        std::memcpy(digits, value, 8);
+        std::memcpy(digits + 8, value + 9, 4);
+        std::memcpy(digits + 12, value + 14, 4);
+        std::memcpy(digits + 16, value + 19, 4);
+        std::memcpy(digits + 20, value + 24, 12);
+
+        bool sawLower = false, sawUpper = false;
+        int64_t w0 = decodeHex8(digits, sawLower, sawUpper);
+        int64_t w1 = decodeHex8(digits + 8, sawLower, sawUpper);
+        int64_t w2 = decodeHex8(digits + 16, sawLower, sawUpper);
+        int64_t w3 = decodeHex8(digits + 24, sawLower, sawUpper);
+
+        // Mixed case isn't a uuid, as it wouldn't print back the same
+        if (w0 == -1 || w1 == -1 || w2 == -1 || w3 == -1
+            || (sawLower && sawUpper))
+            break;
 
-        r.type = capsType == 1 ? UUID_CAPS : UUID;
-        r.f1 = f1;  r.f2 = f2;  r.f3 = f3;  r.f4 = f4;  r.f5 = f5;
+        r.type = sawUpper ? UUID_CAPS : UUID;
+        r.f1 = w0;
+        r.f2 = w1 >> 16;
+        r.f3 = w1 & 0xffff;
+        r.f4 = w2 >> 16;
+        r.f5 = (uint64_t)(w2 & 0xffff) << 32 | w3;
         finish();
         return;
     }
@@ -351,7 +428,16 @@ parse(const char * value, size_t len, Type type)
         bool error = false;
 
         int maxLowLen = min(len, max64_base10_len);
-        for (unsigned i = 0; i < maxLowLen; ++i) {
+        int i = 0;
+        for (; i + 8 <= maxLowLen;  i += 8) {
+            int64_t v = decodeDec8(value + i);
+            if (v == -1) {
+                error = true;
+                break;
+            }
+            res64 = 100000000 * res64 + v;
+        }
+        for (; !error && i < maxLowLen; ++i) {
             if (!isdigit(value[i])) {
                 error = true;
                 break;
@@ -414,39 +500,18 @@ parse(const char * value, size_t len, Type type)
     //     << " value = " << value << " type = " << (int)type << endl;
 
     while ((type == UNKNOWN || type == HEX128LC) && len == 32) {
-        uint64_t high, low;
-
-        const char * p = value;
-        bool failed = false;
-
-        auto scanRange = [&] (int start, int len) -> unsigned long long
-            {
-                uint64_t val = 0;
-                for (unsigned i = start;  i != start + len;  ++i) {
-                    int c = p[i];
-                    int v = hexToDec(c);
-
-                    //cerr << "c = " << c << " " << p[i] << " v = " << v << endl;
-
-                    if (v == -1) {
-                        failed = true;
-                        return val;
-                    }
-                    val = (val << 4) + v;
-                }
-
-                //cerr << "val = " << val << " failed = " << failed << endl;
-
-                return val;
-            };
-
-        high = scanRange(0, 16);
-        if (failed)
-            break;
-        low = scanRange(16, 16);
-        if (failed)
+        // Upper case is accepted, even though it prints back as lower
+        bool sawLower = false, sawUpper = false;
+        int64_t w0 = decodeHex8(value, sawLower, sawUpper);
+        int64_t w1 = decodeHex8(value + 8, sawLower, sawUpper);
+        int64_t w2 = decodeHex8(value + 16, sawLower, sawUpper);
+        int64_t w3 = decodeHex8(value + 24, sawLower, sawUpper);
+        if (w0 == -1 || w1 == -1 || w2 == -1 || w3 == -1)
             break;
 
+        uint64_t high = (uint64_t)w0 << 32 | w1;
+        uint64_t low = (uint64_t)w2 << 32 | w3;
+
         r.type = HEX128LC;
         r.val1 = high;
         r.val2 = low;
@@ -497,6 +562,95 @@ compoundId2() const
 }
     
     
+/** Write the toString() representation of an Id that is stored as an
+    integer into the buffer, which must hold MAX_FIXED_CHARS, and return its
+    length.  Returns -1 for the types that hold a string or other Ids.
+*/
+static constexpr size_t MAX_FIXED_CHARS = 40;
+
+static ssize_t formatFixed(const Id & id, char * buf)
+{
+    auto writeHex = [] (char * p, uint64_t v, int numDigits,
+                        const char * digitChars)
+        {
+            for (int i = numDigits - 1;  i >= 0;  --i, v >>= 4)
+                p[i] = digitChars[v & 15];
+        };
+
+    switch (id.type) {
+    case Id::NONE:
+        return 0;
+    case Id::NULLID:
+        std::memcpy(buf, "null", 4);
+        return 4;
+    case Id::UUID:
+    case Id::UUID_CAPS: {
+        // AGID: --> 0828398c-5965-11e0-84c8-0026b937c8e1
+        const char * digitChars = id.type == Id::UUID
+            ? "0123456789abcdef" : "0123456789ABCDEF";
+        writeHex(buf, id.f1, 8, digitChars);
+        buf[8] = '-';
+        writeHex(buf + 9, id.f2, 4, digitChars);
+        buf[13] = '-';
+        writeHex(buf + 14, id.f3, 4, digitChars);
+        buf[18] = '-';
+        writeHex(buf + 19, id.f4, 4, digitChars);
+        buf[23] = '-';
+        writeHex(buf + 24, id.f5, 12, digitChars);
+        return 36;
+    }
+    case Id::GOOG128: {
+        // Google ID: --> CAESEAYra3NIxLT9C8twKrzqaA
+        static const char digitChars[] =
+            "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+            "abcdefghijklmnopqrstuvwxyz-_";
+        std::memcpy(buf, "CAESE", 5);
+        auto v = make128(id.valLow, id.valHigh);
+        for (unsigned i = 0;  i < 21;  ++i) {
+            buf[25 - i] = digitChars[divmod64(v)];
+        }
+        return 26;
+    }
+    case Id::BIGDEC: {
+        // Digits are written from the end, then moved to the start
+        char * end = buf + MAX_FIXED_CHARS;
+        char * p = end;
+        if (id.val2 == 0) {
+            uint64_t v = id.val1;
+            do {
+                *--p = '0' + v % 10;
+                v /= 10;
+            } while (v);
+        }
+        else {
+            auto v = make128(id.valLow, id.valHigh);
+            while (v != 0) {
+                *--p = '0' + divmod10(v);
+            }
+        }
+        std::memmove(buf, p, end - p);
+        return end - p;
+    }
+    case Id::BASE64_96: {
+        static const char digitChars[] =
+            "+/0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+            "abcdefghijklmnopqrstuvwxyz";
+        auto v = make128(id.val1, id.val2);
+        for (unsigned i = 0;  i < 16;  ++i) {
+            buf[15 - i] = digitChars[divmod64(v)];
+        }
+        return 16;
+    }
+    case Id::HEX128LC: {
+        writeHex(buf, id.val1, 16, "0123456789abcdef");
+        writeHex(buf + 16, id.val2, 16, "0123456789abcdef");
+        return 32;
+    }
+    default:
+        return -1;
+    }
+}
+
 size_t
 Id::
 toStringLength() const
@@ -515,8 +669,8 @@ toStringLength() const
         return 26;
     }
     case BIGDEC: {
-        // TODO: can do better than this...
-        return toString().size();
+        char buf[MAX_FIXED_CHARS];
+        return formatFixed(*this, buf);
     }
     case BASE64_96: {
         return 16;
@@ -539,90 +693,12 @@ std::string
 Id::
 toString() const
 {
-    switch (type) {
-    case NONE:
-        return "";
-    case NULLID:
-        return "null";
-    case UUID:
-        return MLDB::format(
-            "%08x-%04x-%04x-%04x-%012llx",
-            (unsigned)f1, (unsigned)f2, (unsigned)f3, (unsigned)f4,
-            (unsigned long long)f5);
-    case UUID_CAPS:
-        return MLDB::format(
-            "%08X-%04X-%04X-%04X-%012llX",
-            (unsigned)f1, (unsigned)f2, (unsigned)f3, (unsigned)f4,
-            (unsigned long long)f5);
-    case GOOG128: {
-        // Google ID: --> CAESEAYra3NIxLT9C8twKrzqaA
-        string result = "CAESE                     ";
-
-        auto b64Encode = [] (unsigned i) -> int
-            {
-                if (i < 10) return i + '0';
-                if (i < 36) return i - 10 + 'A';
-                if (i < 62) return i - 36 + 'a';
-                if (i == 62) return '-';
-                if (i == 63) return '_';
-                throw MLDB::Exception("bad goog base64 char");
-            };
-
-        auto v = make128(valLow, valHigh);
-        for (unsigned i = 0;  i < 21;  ++i) {
-            result[25 - i] = b64Encode(divmod64(v));
-        }
-        return result;
-    }
-    case BIGDEC: {
-        string result;
-        if (val2 == 0) {
-            if (val1 == 0) {
-                return "0";
-            }
-            result.reserve(max64_base10_len);
-            uint64_t v = val1;
-            while (v) {
-                int c = v % 10;
-                v /= 10;
-                result += c + '0';
-            }
-        }
-        else {
-            auto v = make128(valLow, valHigh);
-            result.reserve(32);
-            while (v != 0) {
-                int c = divmod10(v);
-                result += c + '0';
-            }
-        }
-        std::reverse(result.begin(), result.end());
-        return result;
-    }
-    case BASE64_96: {
-        string result = "                ";
+    char buf[MAX_FIXED_CHARS];
+    ssize_t length = formatFixed(*this, buf);
+    if (length != -1)
+        return std::string(buf, length);
 
-        auto b64Encode = [] (unsigned i) -> int
-            {
-                if (i == 0) return '+';
-                if (i == 1) return '/';
-                if (i < 12) return '0' + i - 2;
-                if (i < 38) return 'A' + i - 12;
-                if (i < 64) return 'a' + i - 38;
-                throw MLDB::Exception("bad base64 char");
-            };
-        
-        auto v = make128(val1, val2);
-        for (unsigned i = 0;  i < 16;  ++i) {
-            result[15 - i] = b64Encode(divmod64(v));
-        }
-        return result;
-    }
-    case HEX128LC: {
-        return MLDB::format("%016llx%016llx",
-                          (unsigned long long)val1,
-                          (unsigned long long)val2);
-    }
+    switch (type) {
     case COMPOUND2:
         return compoundId1().toString() + ":" + compoundId2().toString();
     case STR:
@@ -664,7 +740,46 @@ uint64_t
 Id::
 hash() const
 {
-    return Path(toUtf8String()).hash();
+    // This is the same as Path(toUtf8String()).hash(), which is the city
+    // hash of the characters, but without the allocations or the UTF-8
+    // validation that make the generic path show up in ingestion.  Only
+    // strings that can't fail the validation are hashed directly.
+    char buf[MAX_FIXED_CHARS];
+    const char * data = buf;
+    ssize_t length;
+
+    switch (type) {
+    case SHORTSTR:
+        data = shortStr;
+        length = strnlen(shortStr, 16);
+        break;
+    case STR:
+        data = str->data;
+        length = len;
+        break;
+    default:
+        length = formatFixed(*this, buf);
+    }
+
+    if (MLDB_UNLIKELY(length <= 0 || !isPlainAscii(data, length)))
+        return Path(toUtf8String()).hash();
+
+    return CityHash64(data, length);
+}
+
+void
+Id::
+hashMany(const Id * ids, size_t n, uint64_t * hashes)
+{
+    // Heap allocated strings are likely cache misses; ask for them a few
+    // Ids ahead so that they're there by the time we hash them
+    constexpr size_t PREFETCH_AHEAD = 8;
+
+    for (size_t i = 0;  i < n;  ++i) {
+        if (i + PREFETCH_AHEAD < n && ids[i + PREFETCH_AHEAD].type == STR)
+            __builtin_prefetch(ids[i + PREFETCH_AHEAD].str);
+        hashes[i] = ids[i].hash();
+    }
 }
 
 bool
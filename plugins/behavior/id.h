@@ -268,8 +268,17 @@ struct Id {
     // Compatible with the legacy mldb.ai behavior files
     uint64_t legacyHash() const;
 
+    /** Hash compatible with that of Path, ie Path(toUtf8String()).hash().
+        Doesn't allocate memory unless the Id contains non-ASCII
+        characters.
+    */
     uint64_t hash() const;
 
+    /** Put the hash() of each of the n Ids into hashes.  Faster than
+        calling hash() on each when there are many string Ids.
+    */
+    static void hashMany(const Id * ids, size_t n, uint64_t * hashes);
+
     bool complexEqual(const Id & other) const;
     bool complexLess(const Id & other) const;
     uint64_t complexHash() const;
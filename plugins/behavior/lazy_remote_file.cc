@@ -0,0 +1,342 @@
+/* lazy_remote_file.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Local mapping of a remote file that is filled in on demand.
+*/
+
+#include "lazy_remote_file.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/base/parallel.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/types/db/file_read_buffer.h"
+#include <algorithm>
+#include <iostream>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* LAZY REMOTE FILE                                                          */
+/*****************************************************************************/
+
+constexpr size_t LazyRemoteFile::DEFAULT_CHUNK_SIZE;
+constexpr int LazyRemoteFile::DEFAULT_PREFETCH_CHUNKS;
+
+LazyRemoteFile::
+LazyRemoteFile(const std::string & url,
+               uint64_t size,
+               const std::string & localFile,
+               size_t chunkSize,
+               int prefetchChunks)
+    : url_(url), size_(size), localFile_(localFile),
+      chunkSize_(chunkSize), numChunks_(0), prefetchChunks_(prefetchChunks),
+      rangeReads_(url.compare(0, 5, "s3://") == 0),
+      fd_(-1), data_(nullptr), dataMappedSize_(0),
+      present_(nullptr), presentMappedSize_(0),
+      bytesDownloaded_(0), nextChunk_(0), shutdown_(false)
+{
+    if (size == 0)
+        throw MLDB::Exception("can't lazily map empty remote file " + url);
+    if (chunkSize == 0 || chunkSize % 4096 != 0)
+        throw MLDB::Exception("lazy remote file chunk size must be a "
+                              "multiple of 4096");
+
+    numChunks_ = (size + chunkSize - 1) / chunkSize;
+
+    bool resetChunks = false;
+
+    if (localFile.empty()) {
+        // Unlinked temporary file, that disappears with us
+        const char * tmpDir = getenv("TMPDIR");
+        string tmpl = string(tmpDir ? tmpDir : "/tmp") + "/lazy-beh-XXXXXX";
+        fd_ = ::mkstemp(&tmpl[0]);
+        if (fd_ == -1)
+            throw MLDB::Exception(errno, "creating temporary file " + tmpl);
+        ::unlink(tmpl.c_str());
+    }
+    else {
+        fd_ = ::open(localFile.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ == -1)
+            throw MLDB::Exception(errno, "opening local file " + localFile);
+    }
+
+    try {
+        struct stat st;
+        if (::fstat(fd_, &st) == -1)
+            throw MLDB::Exception(errno, "stat of local file " + localFile);
+
+        if ((uint64_t)st.st_size != size) {
+            // New (or unrecognizable) file; make it sparse and of the
+            // right size, and forget about the chunks that we have
+            if (::ftruncate(fd_, 0) == -1 || ::ftruncate(fd_, size) == -1)
+                throw MLDB::Exception(errno, "sizing local file " + localFile);
+            resetChunks = true;
+        }
+
+        void * addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+        if (addr == MAP_FAILED)
+            throw MLDB::Exception(errno, "mapping local file " + localFile);
+        data_ = (const char *)addr;
+        dataMappedSize_ = size;
+
+        // One byte per chunk, in a shared mapping so that other processes
+        // see the chunks that we download
+        if (localFile.empty()) {
+            addr = ::mmap(nullptr, numChunks_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        }
+        else {
+            string chunksFile
+                = localFile + ".chunks-" + std::to_string(chunkSize);
+            int cfd = ::open(chunksFile.c_str(), O_RDWR | O_CREAT, 0644);
+            if (cfd == -1)
+                throw MLDB::Exception(errno, "opening " + chunksFile);
+            struct stat cst;
+            int res = ::fstat(cfd, &cst);
+            if (res != -1 && (resetChunks || cst.st_size != numChunks_)) {
+                res = ::ftruncate(cfd, 0);
+                if (res != -1)
+                    res = ::ftruncate(cfd, numChunks_);
+            }
+            if (res == -1) {
+                int err = errno;
+                ::close(cfd);
+                throw MLDB::Exception(err, "sizing " + chunksFile);
+            }
+            addr = ::mmap(nullptr, numChunks_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, cfd, 0);
+            ::close(cfd);
+        }
+        if (addr == MAP_FAILED)
+            throw MLDB::Exception(errno, "mapping chunk map of " + url);
+        present_ = (uint8_t *)addr;
+        presentMappedSize_ = numChunks_;
+    } catch (...) {
+        if (data_)
+            ::munmap((void *)data_, dataMappedSize_);
+        ::close(fd_);
+        throw;
+    }
+
+    if (prefetchChunks_ > 0)
+        prefetchThread_ = std::thread([this] () { runPrefetchThread(); });
+}
+
+LazyRemoteFile::
+~LazyRemoteFile()
+{
+    if (prefetchThread_.joinable()) {
+        {
+            std::unique_lock<std::mutex> guard(mutex_);
+            shutdown_ = true;
+        }
+        prefetchWaiting_.notify_all();
+        prefetchThread_.join();
+    }
+
+    ::munmap(present_, presentMappedSize_);
+    ::munmap((void *)data_, dataMappedSize_);
+    ::close(fd_);
+}
+
+File_Read_Buffer
+LazyRemoteFile::
+buffer()
+{
+    auto self = shared_from_this();
+    return File_Read_Buffer(data_, size_, url_, [self] () {});
+}
+
+void
+LazyRemoteFile::
+ensure(uint64_t offset, uint64_t length) const
+{
+    if (length == 0 || offset >= size_)
+        return;
+    uint64_t end = length > size_ - offset ? size_ : offset + length;
+
+    size_t first = offset / chunkSize_;
+    size_t last = (end - 1) / chunkSize_;
+
+    std::vector<size_t> missing;
+    for (size_t c = first;  c <= last;  ++c) {
+        if (!isPresent(c))
+            missing.push_back(c);
+    }
+
+    if (missing.size() == 1) {
+        fetchChunk(missing[0]);
+    }
+    else if (!missing.empty()) {
+        parallelMap(0, missing.size(),
+                    [&] (size_t i) { fetchChunk(missing[i]); });
+    }
+
+    // A read that carries on into the chunk after the previous one means
+    // that we're scanning, so read ahead of it
+    size_t expected = nextChunk_.exchange(last + 1);
+    if (prefetchChunks_ > 0 && first <= expected && last >= expected)
+        prefetchAfter(last);
+}
+
+size_t
+LazyRemoteFile::
+numResidentChunks() const
+{
+    size_t result = 0;
+    for (size_t c = 0;  c < numChunks_;  ++c)
+        result += isPresent(c);
+    return result;
+}
+
+void
+LazyRemoteFile::
+fetchChunk(size_t chunk) const
+{
+    std::unique_lock<std::mutex> guard(mutex_);
+
+    for (;;) {
+        if (isPresent(chunk))
+            return;
+        if (!inFlight_.count(chunk))
+            break;
+        // Someone else is downloading it; if they fail, we try ourselves
+        chunkDone_.wait(guard);
+    }
+
+    inFlight_.insert(chunk);
+    guard.unlock();
+
+    auto onDone = [&] ()
+        {
+            guard.lock();
+            inFlight_.erase(chunk);
+            guard.unlock();
+            chunkDone_.notify_all();
+        };
+
+    try {
+        downloadChunk(chunk);
+    } catch (...) {
+        onDone();
+        throw;
+    }
+
+    onDone();
+}
+
+void
+LazyRemoteFile::
+downloadChunk(size_t chunk) const
+{
+    uint64_t start = chunk * chunkSize_;
+    uint64_t length = std::min<uint64_t>(chunkSize_, size_ - start);
+
+    std::map<std::string, std::string> options;
+    if (rangeReads_) {
+        options["start-offset"] = std::to_string(start);
+        options["end-offset"] = std::to_string(start + length);
+    }
+
+    filter_istream stream(url_, options);
+    if (!rangeReads_)
+        stream.ignore(start);
+
+    std::string buf(length, '\0');
+    stream.read(&buf[0], length);
+    if (stream.gcount() != length)
+        throw MLDB::Exception("short read of chunk %zd of %s",
+                              chunk, url_.c_str());
+
+    for (uint64_t done = 0;  done < length;) {
+        ssize_t res = ::pwrite(fd_, buf.data() + done, length - done,
+                               start + done);
+        if (res == -1) {
+            if (errno == EINTR)
+                continue;
+            throw MLDB::Exception(errno, "writing chunk of " + url_
+                                  + " to local file");
+        }
+        done += res;
+    }
+
+    // The data is visible through the mapping before we say it's there
+    __atomic_store_n(present_ + chunk, 1, __ATOMIC_RELEASE);
+    bytesDownloaded_ += length;
+}
+
+void
+LazyRemoteFile::
+prefetchAfter(size_t chunk) const
+{
+    size_t end = std::min<size_t>(numChunks_, chunk + 1 + prefetchChunks_);
+
+    bool queued = false;
+    {
+        std::unique_lock<std::mutex> guard(mutex_);
+        for (size_t c = chunk + 1;  c < end;  ++c) {
+            if (isPresent(c) || inFlight_.count(c)
+                || std::find(prefetchQueue_.begin(), prefetchQueue_.end(), c)
+                   != prefetchQueue_.end())
+                continue;
+            prefetchQueue_.push_back(c);
+            queued = true;
+        }
+
+        // Old requests are for scans that have moved on
+        while (prefetchQueue_.size() > size_t(4 * prefetchChunks_))
+            prefetchQueue_.pop_front();
+    }
+
+    if (queued)
+        prefetchWaiting_.notify_one();
+}
+
+void
+LazyRemoteFile::
+runPrefetchThread()
+{
+    for (;;) {
+        std::vector<size_t> toFetch;
+        {
+            std::unique_lock<std::mutex> guard(mutex_);
+            prefetchWaiting_.wait(guard, [&] ()
+                                  {
+                                      return shutdown_
+                                          || !prefetchQueue_.empty();
+                                  });
+            if (shutdown_)
+                return;
+            while (!prefetchQueue_.empty()
+                   && toFetch.size() < size_t(prefetchChunks_)) {
+                toFetch.push_back(prefetchQueue_.front());
+                prefetchQueue_.pop_front();
+            }
+        }
+
+        auto doChunk = [&] (size_t i)
+            {
+                try {
+                    fetchChunk(toFetch[i]);
+                } catch (const std::exception & exc) {
+                    // A read that needs it will try again and report it
+                    cerr << "lazy remote file: error prefetching chunk "
+                         << toFetch[i] << " of " << url_ << ": "
+                         << exc.what() << endl;
+                }
+            };
+
+        parallelMap(0, toFetch.size(), doChunk);
+    }
+}
+
+} // namespace MLDB
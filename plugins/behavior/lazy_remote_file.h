@@ -0,0 +1,126 @@
+/* lazy_remote_file.h                                              -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Local mapping of a remote file that is filled in on demand.
+*/
+
+#pragma once
+
+#include "mapped_behavior_domain.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* LAZY REMOTE FILE                                                          */
+/*****************************************************************************/
+
+/** Memory maps a remote file, such as an S3 object, through a sparse local
+    file of the same size.  The file is divided into fixed size chunks
+    which are downloaded with ranged reads the first time that a part of
+    them is asked for by ensure(), and written into the local file.
+
+    Which chunks are present is recorded in a second file next to the
+    local one, so that the chunks that were downloaded by one process are
+    reused by the others and by later runs.  If no local file name is
+    given, an unlinked temporary file is used instead.
+
+    Reads that continue where the previous one stopped cause the chunks
+    that follow to be downloaded by a background thread, so that scans
+    through a large posting list or subject range don't wait on one
+    request after the other.
+*/
+
+struct LazyRemoteFile
+    : public BehaviorFilePager,
+      public std::enable_shared_from_this<LazyRemoteFile> {
+
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 1024 * 1024;
+    static constexpr int DEFAULT_PREFETCH_CHUNKS = 16;
+
+    /** Open the remote file at the given url, whose size must be known.
+        Urls other than s3:// ones are read by skipping to the start of
+        each chunk, which is correct but only useful for testing.
+    */
+    LazyRemoteFile(const std::string & url,
+                   uint64_t size,
+                   const std::string & localFile = "",
+                   size_t chunkSize = DEFAULT_CHUNK_SIZE,
+                   int prefetchChunks = DEFAULT_PREFETCH_CHUNKS);
+
+    virtual ~LazyRemoteFile();
+
+    /** Return a buffer over the local mapping.  It keeps this object
+        alive, and must only be read where ensure() has been called.
+    */
+    File_Read_Buffer buffer();
+
+    /** Make sure that the given byte range has been downloaded.  Ranges
+        extending past the end of the file are truncated.  Chunks that are
+        missing are downloaded in parallel.
+    */
+    virtual void ensure(uint64_t offset, uint64_t length) const;
+
+    uint64_t size() const { return size_; }
+    size_t chunkSize() const { return chunkSize_; }
+    size_t numChunks() const { return numChunks_; }
+
+    /// Number of chunks that are present locally
+    size_t numResidentChunks() const;
+
+    /// Number of bytes downloaded by this object
+    uint64_t bytesDownloaded() const { return bytesDownloaded_; }
+
+private:
+    std::string url_;
+    uint64_t size_;
+    std::string localFile_;
+    size_t chunkSize_;
+    size_t numChunks_;
+    int prefetchChunks_;
+    bool rangeReads_;      ///< Can the url be read from an offset?
+
+    int fd_;               ///< Local file
+    const char * data_;    ///< Mapping of the local file
+    size_t dataMappedSize_;
+    uint8_t * present_;    ///< Shared mapping with one byte per chunk
+    size_t presentMappedSize_;
+
+    mutable std::mutex mutex_;
+    mutable std::condition_variable chunkDone_;
+    mutable std::set<size_t> inFlight_;      ///< Chunks being downloaded
+    mutable std::atomic<uint64_t> bytesDownloaded_;
+
+    /// Chunk after the last one read, to detect sequential access
+    mutable std::atomic<size_t> nextChunk_;
+
+    mutable std::deque<size_t> prefetchQueue_;
+    mutable std::condition_variable prefetchWaiting_;
+    bool shutdown_;
+    std::thread prefetchThread_;
+
+    bool isPresent(size_t chunk) const
+    {
+        return __atomic_load_n(present_ + chunk, __ATOMIC_ACQUIRE);
+    }
+
+    /// Make sure the chunk is present, downloading it if need be
+    void fetchChunk(size_t chunk) const;
+
+    /// Download the chunk into the local file
+    void downloadChunk(size_t chunk) const;
+
+    /// Queue the chunks following the given one to be prefetched
+    void prefetchAfter(size_t chunk) const;
+
+    void runPrefetchThread();
+};
+
+} // namespace MLDB
@@ -9,6 +9,7 @@
 #include "mapped_behavior_domain.h"
 #include "mldb/arch/bitops.h"
 #include "mldb/base/exc_assert.h"
+#include "mldb/base/parallel.h"
 #include "mldb/arch/bit_range_ops.h"
 #include "mldb/types/db/persistent.h"
 #include "mldb/utils/vector_utils.h"
@@ -559,6 +560,21 @@ MappedBehaviorDomain(const MLDB::File_Read_Buffer & file)
     load(file);
 }
 
+MappedBehaviorDomain::
+MappedBehaviorDomain(const MLDB::File_Read_Buffer & file,
+                     std::shared_ptr<const BehaviorFilePager> pager)
+    : pager(std::move(pager))
+{
+    ExcAssert(this->pager);
+    this->file = file;
+    if (file.size() >= 8)
+        ensureResident(file.end() - 8, 8);
+    uint64_t md_offset = readTrailingOffset(file);
+    if (md_offset < file.size())
+        ensureResident(file.start() + md_offset, sizeof(Metadata));
+    init(file, md_offset);
+}
+
 void
 MappedBehaviorDomain::
 load(const std::string & filename)
@@ -590,6 +606,9 @@ init(const File_Read_Buffer & file, uint64_t md_offset)
     if (md->idSpaceDeprecated != 0)
         throw MLDB::Exception("id space must be equal to 0");
 
+    if (pager)
+        ensureIndexesResident();
+
     timeQuantum = md->timeQuantum;
     minSubjects = md->minSubjects;
 
@@ -656,6 +675,18 @@ init(const File_Read_Buffer & file, uint64_t md_offset)
     }
     else fileMetadata_ = Json::Value();
 
+    // The time index is optional; files without one have zero offsets
+    if (md->timeIndexOffset != 0) {
+        timeIndexData
+            = (const uint32_t *)(file.start() + md->timeIndexDataOffset);
+        timeIndex.init(file, md->timeIndexOffset, md->numBehaviors + 1);
+        timeIndexBucketSeconds = md->timeIndexBucketSeconds;
+    }
+    else {
+        timeIndexData = nullptr;
+        timeIndexBucketSeconds = 0;
+    }
+
     /* Slicing the subject index in ranges of equal sizes enables us to
        alleviate the loss of performance (in the form of cache misses)
        occurring during lookups in "getSubjectIndex" in the case where the
@@ -709,6 +740,11 @@ init(const File_Read_Buffer & file, uint64_t md_offset)
         { "subjectIndex", md2.subjectIndexOffset },
         { "eof", file.size() } };
 
+    if (hasTimeIndex()) {
+        offsets.emplace_back("timeIndexData", md2.timeIndexDataOffset);
+        offsets.emplace_back("timeIndex", md2.timeIndexOffset);
+    }
+
     MLDB::sort_on_second_ascending(offsets);
 
     cerr << "size map: " << endl;
@@ -857,7 +893,7 @@ getBehaviorTable(SI subj) const
 
         const uint32_t * data;
         int nw;
-        std::tie(data, nw) = entry.getData(subjectDataStore);
+        std::tie(data, nw) = getSubjectData(entry);
         
         //cerr << "getBehaviorTable for " << subj << " with "
         //     << nw << " words and " << entry.numDistinctBehaviors
@@ -875,7 +911,7 @@ getBehaviorTable(SI subj) const
 
         const uint32_t * data;
         int nw;
-        std::tie(data, nw) = entry.getData(subjectDataStore);
+        std::tie(data, nw) = getSubjectData(entry);
 
         if (entry.splitBehaviorTable) {
             // Behavior table is split into two entries
@@ -923,7 +959,7 @@ getTimestampTable(SI subj) const
 
         const uint32_t * data;
         int nw;
-        std::tie(data, nw) = entry.getData(subjectDataStore);
+        std::tie(data, nw) = getSubjectData(entry);
 
         MLDB::Bit_Extractor<uint32_t> extractor(data);
 
@@ -965,7 +1001,7 @@ getEventTable(SI subj) const
 
         const uint32_t * data;
         int nw;
-        std::tie(data, nw) = entry.getData(subjectDataStore);
+        std::tie(data, nw) = getSubjectData(entry);
 
         MLDB::Bit_Extractor<uint32_t> extractor(data);
 
@@ -983,7 +1019,7 @@ getEventTable(SI subj) const
 
         const uint32_t * data;
         int nw;
-        std::tie(data, nw) = entry.getData(subjectDataStore);
+        std::tie(data, nw) = getSubjectData(entry);
 
         MLDB::Bit_Extractor<uint32_t> extractor(data);
 
@@ -1296,12 +1332,27 @@ getSubjectId(SH subjectHash) const
     if (index == -1)
         throw MLDB::Exception("getSubjectId for unknown subject");
 
-    uint64_t offset = subjectIdIndex[index];
+    auto getOffset = [&] (size_t index) -> uint64_t
+        {
+            uint64_t offset = subjectIdIndex[index];
+
+            // Adjustments for offset overflows.
+            for (size_t i : subjectIdAdjustOffsets) {
+                if (index < i) break;
+                offset += 1ULL << 32;
+            }
+
+            return offset;
+        };
+
+    uint64_t offset = getOffset(index);
 
-    // Adjustments for offset overflows.
-    for (size_t i : subjectIdAdjustOffsets) {
-        if (index < i) break;
-        offset += 1ULL << 32;
+    if (pager) {
+        // IDs are written in subject order, so this one ends where the
+        // next one starts
+        uint64_t end = index + 1 < md->numSubjects
+            ? getOffset(index + 1) : subjectIdStoreSize;
+        ensureResident(subjectIdStore + offset, end - offset);
     }
 
     DB::Store_Reader store(subjectIdStore, subjectIdStoreSize);
@@ -1370,6 +1421,119 @@ getBehaviorStats(BH behavior, int fields) const
     return getBehaviorStats(BI(index), fields);
 }
 
+const uint32_t *
+MappedBehaviorDomain::
+getBehaviorSubjectData(BI beh) const
+{
+    const uint32_t * data = behaviorToSubjects + behaviorToSubjectsIndex[beh];
+
+    if (pager) {
+        int numSubjectBits = MLDB::highest_bit(md->numSubjects - 1, -1) + 1;
+        uint64_t numBits
+            = (uint64_t)behaviorStats[beh].subjectCount * numSubjectBits;
+        // Bit extractors may read one word past the end
+        ensureResident(data, ((numBits + 31) / 32 + 2) * 4);
+    }
+
+    return data;
+}
+
+const uint32_t *
+MappedBehaviorDomain::
+getBehaviorTimestampData(BI beh) const
+{
+    ExcAssert(behaviorToSubjectTimestamps);
+
+    const uint32_t * data
+        = behaviorToSubjectTimestamps + behaviorToSubjectTimestampsIndex[beh];
+
+    if (pager) {
+        // The number of bits per timestamp is in the first six bits
+        ensureResident(data, 8);
+        int numTimestampBits = data[0] & 63;
+        uint64_t numBits
+            = 6 + (uint64_t)behaviorStats[beh].subjectCount * numTimestampBits;
+        ensureResident(data, ((numBits + 31) / 32 + 2) * 4);
+    }
+
+    return data;
+}
+
+const uint32_t *
+MappedBehaviorDomain::
+getBehaviorTimeIndexData(BI beh) const
+{
+    ExcAssert(timeIndexData);
+
+    const uint32_t * data = timeIndexData + timeIndex[beh];
+
+    // Bit extractors may read one word past the end
+    ensureResident(data, (timeIndex[beh + 1] - timeIndex[beh] + 2) * 4);
+
+    return data;
+}
+
+void
+MappedBehaviorDomain::
+ensureIndexesResident() const
+{
+    const Metadata & m = *md;
+
+    bool hasTimestamps = m.version >= 2;
+    bool hasIds = m.version >= 1
+        && (m.subjectIdDataOffset > 0 || m.numSubjects == 0);
+    bool hasFileMetadata = m.version >= 3;
+
+    // Where each section starts, which is where the one before it ends
+    std::vector<uint64_t> starts = {
+        m.behaviorIndexOffset, m.behaviorIdOffset, m.behaviorIdIndexOffset,
+        m.behaviorInfoOffset, m.subjectDataOffset, m.subjectIndexOffset,
+        m.behaviorSubjectsOffset, m.behaviorToSubjectsIndexOffset,
+        (uint64_t)((const char *)md.operator -> () - file.start()),
+        file.size() };
+    if (hasTimestamps) {
+        starts.push_back(m.behaviorToSubjectTimestampsOffset);
+        starts.push_back(m.behaviorToSubjectTimestampsIndexOffset);
+    }
+    if (hasIds) {
+        starts.push_back(m.subjectIdDataOffset);
+        starts.push_back(m.subjectIdIndexOffset);
+    }
+    if (hasFileMetadata)
+        starts.push_back(m.fileMetadataOffset);
+    if (m.timeIndexOffset != 0) {
+        starts.push_back(m.timeIndexDataOffset);
+        starts.push_back(m.timeIndexOffset);
+    }
+
+    std::sort(starts.begin(), starts.end());
+
+    auto ensureSection = [&] (uint64_t start)
+        {
+            auto it = std::upper_bound(starts.begin(), starts.end(), start);
+            if (it == starts.end())
+                return;
+            pager->ensure(start, *it - start);
+        };
+
+    // Everything that is looked up by behavior or subject number.  The
+    // behavior IDs are small enough to be included.
+    ensureSection(m.behaviorIndexOffset);
+    ensureSection(m.behaviorIdOffset);
+    ensureSection(m.behaviorIdIndexOffset);
+    ensureSection(m.behaviorInfoOffset);
+    ensureSection(m.subjectIndexOffset);
+    ensureSection(m.behaviorToSubjectsIndexOffset);
+    if (hasTimestamps)
+        ensureSection(m.behaviorToSubjectTimestampsIndexOffset);
+    if (hasIds)
+        ensureSection(m.subjectIdIndexOffset);
+    if (hasFileMetadata)
+        ensureSection(m.fileMetadataOffset);
+    if (m.timeIndexOffset != 0)
+        ensureSection(m.timeIndexOffset);
+}
+
 size_t
 MappedBehaviorDomain::
 getBehaviorSubjectCount(BI beh, SH maxSubject, Precision p) const
@@ -1377,7 +1541,7 @@ getBehaviorSubjectCount(BI beh, SH maxSubject, Precision p) const
     if (maxSubject.isMax())
         return behaviorStats[beh].subjectCount;
 
-    const uint32_t * data = behaviorToSubjects + behaviorToSubjectsIndex[beh];
+    const uint32_t * data = getBehaviorSubjectData(beh);
 
     int len = behaviorStats[beh].subjectCount;
     int numSubjectBits = MLDB::highest_bit(md->numSubjects - 1, -1) + 1;
@@ -1405,7 +1569,7 @@ std::vector<SH>
 MappedBehaviorDomain::
 getSubjectHashes(BI beh, SH maxSubject, bool sorted) const
 {
-    const uint32_t * data = behaviorToSubjects + behaviorToSubjectsIndex[beh];
+    const uint32_t * data = getBehaviorSubjectData(beh);
 
     int len = getBehaviorSubjectCount(beh);
     int numSubjectBits = MLDB::highest_bit(md->numSubjects - 1, -1) + 1;
@@ -1440,6 +1604,356 @@ getSubjectHashes(BH beh, SH maxSubject, bool sorted) const
     return getSubjectHashes(BI(index), maxSubject, sorted);
 }
 
+
+namespace {
+
+/** The sorted subject indexes of a behavior, as stored in the behavior to
+    subjects table.  Every entry has the same number of bits, so any entry
+    can be read without decoding the ones before it, which is what allows
+    the lists to be intersected by skipping through them.
+*/
+struct SubjectList {
+    const uint32_t * data;
+    int bits;
+    size_t size;
+
+    uint32_t operator [] (size_t i) const
+    {
+        if (bits == 0)
+            return 0;
+        MLDB::Bit_Extractor<uint32_t> extractor(data);
+        extractor.advance(i * bits);
+        return extractor.extract<uint32_t>(bits);
+    }
+
+    /// Decode the n entries starting at start into out
+    void decode(size_t start, size_t n, uint32_t * out) const
+    {
+        if (bits == 0) {
+            std::fill(out, out + n, 0);
+            return;
+        }
+        MLDB::Bit_Extractor<uint32_t> extractor(data);
+        extractor.advance(start * bits);
+        for (size_t i = 0;  i < n;  ++i)
+            out[i] = extractor.extract<uint32_t>(bits);
+    }
+
+    /** Return the position of the first entry at or after pos that is
+        not less than val, or size if there is none.  This searches with
+        exponentially growing steps from pos and then bisects, so that
+        skipping over k entries costs O(log k) reads.
+    */
+    size_t gallop(size_t pos, uint32_t val) const
+    {
+        if (pos >= size || (*this)[pos] >= val)
+            return pos;
+
+        // Invariant: entry lo < val, and hi == size or entry hi >= val
+        size_t lo = pos, hi = pos + 1, step = 1;
+        while (hi < size && (*this)[hi] < val) {
+            lo = hi;
+            step *= 2;
+            hi = std::min(size, lo + step);
+        }
+
+        while (hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            if ((*this)[mid] < val)
+                lo = mid;
+            else hi = mid;
+        }
+
+        return hi;
+    }
+};
+
+SubjectList getSubjectList(const MappedBehaviorDomain & domain, BI beh)
+{
+    return { domain.getBehaviorSubjectData(beh),
+             MLDB::highest_bit(domain.md->numSubjects - 1, -1) + 1,
+             domain.behaviorStats[beh].subjectCount };
+}
+
+/// Lists this many times longer than the candidates are galloped through
+/// rather than scanned
+constexpr size_t GALLOP_RATIO = 16;
+
+/// Number of entries decoded at once when scanning
+constexpr size_t DECODE_BLOCK_SIZE = 256;
+
+/** Merge sorted lists of subject indexes into one, in pairs, so that each
+    subject is copied O(log n) times.
+*/
+std::vector<uint32_t>
+uniteSubjectLists(std::vector<std::vector<uint32_t> > parts)
+{
+    if (parts.empty())
+        return {};
+
+    while (parts.size() > 1) {
+        std::vector<std::vector<uint32_t> > merged;
+        for (size_t i = 0;  i + 1 < parts.size();  i += 2) {
+            merged.emplace_back();
+            merged.back().reserve(parts[i].size() + parts[i + 1].size());
+            std::set_union(parts[i].begin(), parts[i].end(),
+                           parts[i + 1].begin(), parts[i + 1].end(),
+                           std::back_inserter(merged.back()));
+        }
+        if (parts.size() % 2)
+            merged.emplace_back(std::move(parts.back()));
+        parts = std::move(merged);
+    }
+
+    return std::move(parts[0]);
+}
+
+} // file scope
+
+std::vector<uint32_t>
+MappedBehaviorDomain::
+intersectBehaviorSubjects(const std::vector<BI> & behs) const
+{
+    if (behs.empty())
+        return {};
+
+    std::vector<SubjectList> lists;
+    for (BI beh: behs)
+        lists.push_back(getSubjectList(*this, beh));
+
+    // Start from the shortest list; the candidates only ever get fewer
+    std::sort(lists.begin(), lists.end(),
+              [] (const SubjectList & l1, const SubjectList & l2)
+              {
+                  return l1.size < l2.size;
+              });
+
+    std::vector<uint32_t> result(lists[0].size);
+    lists[0].decode(0, lists[0].size, result.data());
+
+    for (size_t l = 1;  l < lists.size() && !result.empty();  ++l) {
+        const SubjectList & list = lists[l];
+        size_t numOut = 0;
+
+        if (result.size() * GALLOP_RATIO < list.size) {
+            // Much longer than the candidates: skip through it, only
+            // reading the entries needed to locate each candidate
+            size_t pos = 0;
+            for (uint32_t subject: result) {
+                pos = list.gallop(pos, subject);
+                if (pos == list.size)
+                    break;
+                if (list[pos] == subject)
+                    result[numOut++] = subject;
+            }
+        }
+        else {
+            // Similar lengths: merge, decoding a block at a time and
+            // skipping blocks that end before the next candidate
+            uint32_t block[DECODE_BLOCK_SIZE];
+            size_t i = 0;
+            for (size_t start = 0;
+                 start < list.size && i < result.size();
+                 start += DECODE_BLOCK_SIZE) {
+                size_t n = std::min(DECODE_BLOCK_SIZE, list.size - start);
+                if (list[start + n - 1] < result[i])
+                    continue;
+                list.decode(start, n, block);
+
+                size_t j = 0;
+                while (i < result.size() && j < n) {
+                    uint32_t s1 = result[i], s2 = block[j];
+                    if (s1 == s2)
+                        result[numOut++] = s1;
+                    i += s1 <= s2;
+                    j += s1 >= s2;
+                }
+            }
+        }
+
+        result.resize(numOut);
+    }
+
+    return result;
+}
+
+std::vector<uint32_t>
+MappedBehaviorDomain::
+unionBehaviorSubjects(const std::vector<BI> & behs) const
+{
+    std::vector<std::vector<uint32_t> > parts;
+    for (BI beh: behs) {
+        SubjectList list = getSubjectList(*this, beh);
+        parts.emplace_back(list.size);
+        list.decode(0, list.size, parts.back().data());
+    }
+
+    return uniteSubjectLists(std::move(parts));
+}
+
+std::vector<SH>
+MappedBehaviorDomain::
+getSubjectsWithAllBehaviors(const std::vector<BH> & behs,
+                            SH maxSubject) const
+{
+    std::vector<BI> indexes;
+    for (BH beh: behs) {
+        int index = behaviorIndex.get(beh, -1);
+        if (index == -1)
+            return {};
+        indexes.push_back(BI(index));
+    }
+
+    std::vector<SH> result;
+    for (uint32_t subject: intersectBehaviorSubjects(indexes)) {
+        SH hash = getSubjectHash(SI(subject));
+        if (hash > maxSubject)
+            break;
+        result.push_back(hash);
+    }
+    return result;
+}
+
+std::vector<SH>
+MappedBehaviorDomain::
+getSubjectsWithAnyBehavior(const std::vector<BH> & behs,
+                           SH maxSubject) const
+{
+    std::vector<BI> indexes;
+    for (BH beh: behs) {
+        int index = behaviorIndex.get(beh, -1);
+        if (index != -1)
+            indexes.push_back(BI(index));
+    }
+
+    std::vector<SH> result;
+    for (uint32_t subject: unionBehaviorSubjects(indexes)) {
+        SH hash = getSubjectHash(SI(subject));
+        if (hash > maxSubject)
+            break;
+        result.push_back(hash);
+    }
+    return result;
+}
+
+std::vector<uint32_t>
+MappedBehaviorDomain::
+getBehaviorSubjectsBetween(BI beh, Date earliest, Date latest) const
+{
+    const BehaviorStatsFormat & stats = behaviorStats[beh];
+    if (!(earliest < latest)
+        || latest <= stats.earliest || earliest > stats.latest)
+        return {};
+
+    const uint32_t * data = getBehaviorTimeIndexData(beh);
+    uint32_t numBuckets = data[0];
+    const uint32_t * buckets = data + 1;
+    const uint32_t * lists = buckets + 2 * numBuckets;
+
+    int numSubjectBits = MLDB::highest_bit(md->numSubjects - 1, -1) + 1;
+    double width = timeIndexBucketSeconds;
+    int64_t firstBucket
+        = getTimeIndexBucket(unQuantizeTime(md->earliest), width);
+
+    std::vector<std::vector<uint32_t> > inside;
+    std::vector<uint32_t> straddling;
+
+    for (uint32_t i = 0;  i < numBuckets;  ++i) {
+        int64_t bucket = firstBucket + buckets[i * 2];
+        SubjectList list = { lists, numSubjectBits, buckets[i * 2 + 1] };
+        lists += ((uint64_t)list.size * numSubjectBits + 31) / 32;
+
+        Date start = Date::fromSecondsSinceEpoch(bucket * width);
+        Date end = Date::fromSecondsSinceEpoch((bucket + 1) * width);
+        if (end <= earliest || start >= latest)
+            continue;
+
+        std::vector<uint32_t> subjects(list.size);
+        list.decode(0, list.size, subjects.data());
+
+        if (start >= earliest && end <= latest)
+            inside.emplace_back(std::move(subjects));
+        else straddling.insert(straddling.end(),
+                               subjects.begin(), subjects.end());
+    }
+
+    std::vector<uint32_t> result = uniteSubjectLists(std::move(inside));
+
+    if (straddling.empty())
+        return result;
+
+    // Subjects from the buckets at the ends of the range that we don't
+    // already have need their events checked
+    std::sort(straddling.begin(), straddling.end());
+    straddling.erase(std::unique(straddling.begin(), straddling.end()),
+                     straddling.end());
+
+    std::vector<uint32_t> candidates;
+    std::set_difference(straddling.begin(), straddling.end(),
+                        result.begin(), result.end(),
+                        std::back_inserter(candidates));
+
+    BH behHash = stats.hash;
+    EventFilter filter(earliest, latest);
+    filter.filterBehInList(std::vector<BH>({ behHash }));
+
+    std::vector<char> matches(candidates.size());
+
+    auto checkCandidate = [&] (size_t i)
+        {
+            auto onBeh = [&] (BH b, Date ts, uint32_t count)
+                {
+                    if (b == behHash && ts >= earliest && ts < latest) {
+                        matches[i] = true;
+                        return false;
+                    }
+                    return true;
+                };
+
+            forEachSubjectBehaviorHash(getSubjectHash(SI(candidates[i])),
+                                       onBeh, filter);
+        };
+
+    parallelMap(0, candidates.size(), checkCandidate);
+
+    std::vector<uint32_t> matched;
+    for (size_t i = 0;  i < candidates.size();  ++i) {
+        if (matches[i])
+            matched.push_back(candidates[i]);
+    }
+
+    std::vector<uint32_t> merged;
+    merged.reserve(result.size() + matched.size());
+    std::merge(result.begin(), result.end(), matched.begin(), matched.end(),
+               std::back_inserter(merged));
+
+    return merged;
+}
+
+std::vector<SH>
+MappedBehaviorDomain::
+getSubjectsWithBehaviorBetween(BH beh, Date earliest, Date latest,
+                               SH maxSubject) const
+{
+    if (!hasTimeIndex())
+        return BehaviorDomain::getSubjectsWithBehaviorBetween
+            (beh, earliest, latest, maxSubject);
+
+    int index = behaviorIndex.get(beh, -1);
+    if (index == -1)
+        return {};
+
+    std::vector<SH> result;
+    for (uint32_t subject: getBehaviorSubjectsBetween(BI(index), earliest,
+                                                      latest)) {
+        SH hash = getSubjectHash(SI(subject));
+        if (hash > maxSubject)
+            break;
+        result.push_back(hash);
+    }
+    return result;
+}
+
 std::vector<std::pair<SH, Date> >
 MappedBehaviorDomain::
 getSubjectHashesAndTimestamps(BH beh, SH maxSubject, bool sorted) const
@@ -1458,17 +1972,13 @@ getSubjectHashesAndTimestamps(BI index, SH maxSubject, bool sorted) const
 
     auto stats = getBehaviorStats(index, BS_EARLIEST | BS_SUBJECT_COUNT);
 
-    const uint32_t * subjectData
-        = behaviorToSubjects + behaviorToSubjectsIndex[index];
+    const uint32_t * subjectData = getBehaviorSubjectData(BI(index));
 
     bool hasTimestamps = behaviorToSubjectTimestamps != 0;
 
-    uint32_t offset = 0;
+    const uint32_t * subjectTimestampData = nullptr;
     if (hasTimestamps)
-        offset = behaviorToSubjectTimestampsIndex[index];
-
-    const uint32_t * subjectTimestampData
-        = behaviorToSubjectTimestamps + offset;
+        subjectTimestampData = getBehaviorTimestampData(BI(index));
 
     //cerr << "index = " << index << " offset = " << offset
     //     << " subjectCount = " << stats.subjectCount << endl;
@@ -1534,19 +2044,15 @@ forEachBehaviorSubject(BH beh,
 
     auto stats = getBehaviorStats(BI(index), BS_EARLIEST | BS_SUBJECT_COUNT);
 
-    const uint32_t * subjectData
-        = behaviorToSubjects + behaviorToSubjectsIndex[index];
+    const uint32_t * subjectData = getBehaviorSubjectData(BI(index));
 
     bool hasTimestamps = behaviorToSubjectTimestamps != 0;
     if (withTimestamps && !hasTimestamps)
         throw MLDB::Exception("asked for timestamps with none present");
 
-    uint32_t offset = 0;
+    const uint32_t * subjectTimestampData = nullptr;
     if (hasTimestamps)
-        offset = behaviorToSubjectTimestampsIndex[index];
-
-    const uint32_t * subjectTimestampData
-        = behaviorToSubjectTimestamps + offset;
+        subjectTimestampData = getBehaviorTimestampData(BI(index));
 
     //cerr << "index = " << index << " offset = " << offset
     //     << " subjectCount = " << stats.subjectCount << endl;
@@ -1808,9 +2314,7 @@ coIterateBehaviorsScan(BI behi1, BI behi2,
 
     auto getExtractor = [&] (BI beh)
         {
-            const uint32_t * data
-            = behaviorToSubjects
-            + behaviorToSubjectsIndex[beh];
+            const uint32_t * data = getBehaviorSubjectData(beh);
 
             return MLDB::Bit_Extractor<uint32_t>(data);
         };
@@ -1897,9 +2401,7 @@ coIterateBehaviorsLookup(BI behi1, BI behi2,
 
     auto getExtractor = [&] (BI beh)
         {
-            const uint32_t * data
-            = behaviorToSubjects
-            + behaviorToSubjectsIndex[beh];
+            const uint32_t * data = getBehaviorSubjectData(beh);
 
             return MLDB::Bit_Extractor<uint32_t>(data);
         };
@@ -1910,9 +2412,7 @@ coIterateBehaviorsLookup(BI behi1, BI behi2,
     typedef MLDB::BitArrayIterator<uint32_t> BitArrayIterator;
 
     int len1 = e1.subjectCount;
-    const uint32_t * data1
-        = behaviorToSubjects
-        + behaviorToSubjectsIndex[behi1];
+    const uint32_t * data1 = getBehaviorSubjectData(behi1);
 
     BitArrayIterator
         start(data1, numSubjectBits, 0),
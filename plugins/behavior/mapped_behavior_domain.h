@@ -10,6 +10,7 @@
 #include "behavior_domain.h"
 #include "mapped_value.h"
 #include "mldb/arch/bit_range_ops.h"
+#include <cmath>
 
 
 namespace MLDB {
@@ -26,6 +27,24 @@ namespace MLDB {
 #endif
 
 
+/*****************************************************************************/
+/* BEHAVIOR FILE PAGER                                                       */
+/*****************************************************************************/
+
+/** Interface for a behavior file whose mapping is filled in on demand, for
+    example from a remote object that is read by byte range.  The domain
+    calls ensure() before it reads any part of the file, which must not
+    return until that byte range can be read through the mapping.
+*/
+struct BehaviorFilePager {
+    virtual ~BehaviorFilePager()
+    {
+    }
+
+    virtual void ensure(uint64_t offset, uint64_t length) const = 0;
+};
+
+
 /*****************************************************************************/
 /* MAPPED BEHAVIOR DOMAIN                                                   */
 /*****************************************************************************/
@@ -35,6 +54,14 @@ struct MappedBehaviorDomain: public BehaviorDomain {
     MappedBehaviorDomain(const std::string & filename);
     MappedBehaviorDomain(const MLDB::File_Read_Buffer & file);
 
+    /** Map a file that is paged in on demand.  The metadata and the indexes
+        are made resident when the domain is opened; the subject data, the
+        posting lists and the subject IDs are made resident as they are
+        accessed.
+    */
+    MappedBehaviorDomain(const MLDB::File_Read_Buffer & file,
+                         std::shared_ptr<const BehaviorFilePager> pager);
+
     void load(const std::string & filename);
     void load(const MLDB::File_Read_Buffer & file);
 
@@ -346,6 +373,57 @@ struct MappedBehaviorDomain: public BehaviorDomain {
     getSubjectHashes(BH beh, SH maxSubject = SH(-1), bool sorted = false)
         const;
 
+    virtual std::vector<SH>
+    getSubjectsWithAllBehaviors(const std::vector<BH> & behs,
+                                SH maxSubject = SH::max()) const;
+
+    virtual std::vector<SH>
+    getSubjectsWithAnyBehavior(const std::vector<BH> & behs,
+                               SH maxSubject = SH::max()) const;
+
+    /** Return the sorted indexes of the subjects that have all of the
+        given behaviors.  The shortest subject list is decoded and the
+        others are galloped through (or, when of similar length, merged
+        block by block), so long lists are mostly never decoded.
+    */
+    std::vector<uint32_t>
+    intersectBehaviorSubjects(const std::vector<BI> & behs) const;
+
+    /** Return the sorted indexes of the subjects that have any of the
+        given behaviors.
+    */
+    std::vector<uint32_t>
+    unionBehaviorSubjects(const std::vector<BI> & behs) const;
+
+    virtual std::vector<SH>
+    getSubjectsWithBehaviorBetween(BH beh, Date earliest, Date latest,
+                                   SH maxSubject = SH::max()) const;
+
+    /** Does the file have a time index, with the subjects of each
+        behavior for each bucket of timeIndexBucketSeconds?
+    */
+    bool hasTimeIndex() const
+    {
+        return timeIndexData != nullptr;
+    }
+
+    /** Bucket of the time index that the given time falls in.  Buckets
+        are aligned on the epoch, so that day buckets are UTC days.
+    */
+    static int64_t getTimeIndexBucket(Date ts, double bucketSeconds)
+    {
+        return (int64_t)std::floor(ts.secondsSinceEpoch() / bucketSeconds);
+    }
+
+    /** Return the sorted indexes of the subjects that had the behavior at
+        a time in [earliest, latest), from the time index.  Buckets that
+        are entirely within the range are merged without looking any
+        further; the subjects of the (at most two) buckets that straddle
+        its ends are checked against their events.
+    */
+    std::vector<uint32_t>
+    getBehaviorSubjectsBetween(BI beh, Date earliest, Date latest) const;
+
     virtual std::vector<std::pair<SH, Date> >
     getSubjectHashesAndTimestamps(BI beh, SH maxSubject = SH(-1),
                                   bool sorted = false) const;
@@ -452,7 +530,10 @@ struct MappedBehaviorDomain: public BehaviorDomain {
         uint64_t idSpaceDeprecated = 0;
         uint64_t fileMetadataOffset = 0;
         uint64_t totalEventsRecorded = 0;
-        uint64_t forExpansion[504] = {0};
+        uint64_t timeIndexOffset = 0;      ///< Zero if there is no time index
+        uint64_t timeIndexDataOffset = 0;
+        double   timeIndexBucketSeconds = 0;
+        uint64_t forExpansion[501] = {0};
     };
 
     /** This is the format into which behavior stats are mapped. */
@@ -478,6 +559,41 @@ struct MappedBehaviorDomain: public BehaviorDomain {
 
     MLDB::File_Read_Buffer file;
 
+    /// Pages in parts of the file on demand; null when it's all resident
+    std::shared_ptr<const BehaviorFilePager> pager;
+
+    /// Make sure that the given range of the file can be read
+    void ensureResident(const void * start, uint64_t length) const
+    {
+        if (MLDB_UNLIKELY(pager.get() != nullptr))
+            pager->ensure((const char *)start - file.start(), length);
+    }
+
+    /// Return the subject data of the entry, making sure it's resident
+    template<typename Entry>
+    std::pair<const uint32_t *, uint32_t>
+    getSubjectData(const Entry & entry) const
+    {
+        auto result = entry.getData(subjectDataStore);
+        // Bit extractors may read one word past the end
+        ensureResident(result.first, (result.second + 2) * 4);
+        return result;
+    }
+
+    /// Return the list of subjects that have the behavior, resident
+    const uint32_t * getBehaviorSubjectData(BI beh) const;
+
+    /// Return the list of subject timestamps of the behavior, resident
+    const uint32_t * getBehaviorTimestampData(BI beh) const;
+
+    /// Return the time index entry of the behavior, resident
+    const uint32_t * getBehaviorTimeIndexData(BI beh) const;
+
+    /** Make the sections of the file that are accessed by index lookups,
+        as opposed to the data that they point to, resident.
+    */
+    void ensureIndexesResident() const;
+
     MappedValue<Metadata> md;
     MappedSortedKeyValueArray<BH, uint32_t> behaviorIndex; /// beh -> behindex
     MappedArray<uint32_t> behaviorIdIndex;     /// behindex -> idoffset
@@ -496,6 +612,15 @@ struct MappedBehaviorDomain: public BehaviorDomain {
     const uint32_t * behaviorToSubjectTimestamps;
     MappedArray<uint32_t> behaviorToSubjectTimestampsIndex;
 
+    /** Time index.  The entry of each behavior is, in 32 bit words: the
+        number of buckets n; n (bucket, subject count) pairs, with buckets
+        relative to the bucket of the earliest time; and then the sorted
+        subject indexes of each bucket, packed like the behavior to
+        subjects lists, each list starting on a word boundary.
+    */
+    const uint32_t * timeIndexData;
+    MappedArray<uint64_t> timeIndex;  ///< behindex -> word offset; n + 1
+
     MappedArray<uint32_t> subjectIdIndex;
     const char * subjectIdStore;
     size_t subjectIdStoreSize;
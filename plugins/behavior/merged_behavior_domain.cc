@@ -7,6 +7,7 @@
 */
 
 #include "merged_behavior_domain.h"
+#include "mapped_behavior_domain.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/utils/pair_utils.h"
 #include "mldb/arch/timers.h"
@@ -1419,4 +1420,26 @@ getAllFileMetadata() const
 }
 
 
+/*****************************************************************************/
+/* MERGE BEHAVIOR FILES                                                      */
+/*****************************************************************************/
+
+void mergeBehaviorFiles(const std::vector<std::string> & inputFiles,
+                        const std::string & outputFile,
+                        ssize_t maxSubjectBehaviors)
+{
+    std::vector<std::shared_ptr<BehaviorDomain> > toMerge(inputFiles.size());
+
+    auto openFile = [&] (int i)
+        {
+            toMerge[i] = std::make_shared<MappedBehaviorDomain>(inputFiles[i]);
+        };
+
+    parallelMap(0, inputFiles.size(), openFile);
+
+    MergedBehaviorDomain merged(toMerge, true /* preIndex */);
+    merged.save(outputFile, maxSubjectBehaviors);
+}
+
+
 } // namespace MLDB
@@ -198,4 +198,15 @@ public:
 };
 
 
+/** Merge the given behavior files into a single new behavior file.  The
+    inputs are memory mapped rather than loaded, and are merged k ways
+    by a MergedBehaviorDomain as the output is serialized.  Empty inputs
+    are skipped.
+*/
+void mergeBehaviorFiles(const std::vector<std::string> & inputFiles,
+                        const std::string & outputFile,
+                        ssize_t maxSubjectBehaviors
+                            = BehaviorDomain::KEEP_ALL_BEHAVIORS);
+
+
 } // namespace MLDB
@@ -66,7 +66,6 @@ MutableBehaviorDomain(int minSubjects)
       latest_(-INFINITY),
       nominalStart_(Date::positiveInfinity()),
       nominalEnd_(Date::negativeInfinity()),
-      totalEventsRecorded_(0),
       immutable_(false),
       behaviorRoot(rootLock),
       behaviorPartialCache(rootLock),
@@ -85,7 +84,6 @@ MutableBehaviorDomain(const MutableBehaviorDomain & other)
       latest_(other.latest_.load()),
       nominalStart_(other.nominalStart_),
       nominalEnd_(other.nominalEnd_),
-      totalEventsRecorded_(other.totalEventsRecorded_.load()),
       immutable_(false),
       behaviorRoot(rootLock),
       behaviorPartialCache(rootLock),
@@ -170,7 +168,7 @@ recordImpl(const Id & subject,
 
     atomic_min(earliest_, ts_);
     atomic_max(latest_, ts_);
-    totalEventsRecorded_ += 1;
+    subjectRoots[subjectIndex.root]->eventsRecorded += 1;
     
     uint64_t ts = quantizeTime(ts_);
 
@@ -289,7 +287,7 @@ recordMany(const Id & subject,
     atomic_min(earliest_, entryMin);
     atomic_max(latest_, entryMax);
 
-    totalEventsRecorded_ += n;
+    subjectRoots[subjectIndex.root]->eventsRecorded += n;
 }
 
 void
@@ -360,7 +358,7 @@ recordMany(const Id & subject,
     atomic_min(earliest_, entryMin);
     atomic_max(latest_, entryMax);
 
-    totalEventsRecorded_ += n;
+    subjectRoots[subjectIndex.root]->eventsRecorded += n;
 }
 
 void
@@ -379,6 +377,7 @@ recordManySubjects(const Id & beh,
 
     Date entryMin = Date::positiveInfinity();
     Date entryMax = Date::negativeInfinity();
+    SI2 lastSubjectIndex;
 
     for (unsigned i = 0;  i < n;  ++i) {
         ManySubjectId entry = first[i];
@@ -391,6 +390,7 @@ recordManySubjects(const Id & beh,
         SI2 subjectIndex;
         std::tie(subjectEntry, subjectIndex)
             = obtainSubjectEntryAndIndex(entry.subject);
+        lastSubjectIndex = subjectIndex;
         
         BI behaviorIndex = behaviorEntry->index;
 
@@ -416,7 +416,8 @@ recordManySubjects(const Id & beh,
     atomic_min(earliest_, entryMin);
     atomic_max(latest_, entryMax);
 
-    totalEventsRecorded_ += n;
+    // Any root will do for the count; the last subject's is as good as any
+    subjectRoots[lastSubjectIndex.root]->eventsRecorded += n;
 }
 
 void
@@ -435,14 +436,20 @@ recordMany(const Id * behIds,
 
     ExcAssert(!immutable_);
 
+    // Hash all of the ids in one go before looking them up
+    std::vector<uint64_t> hashes(std::max(numSubjectIds, numBehIds));
+
+    Id::hashMany(subjectIds, numSubjectIds, hashes.data());
     std::vector<std::pair<SubjectEntry *, SI2> > subjectEntries(numSubjectIds);
     for (unsigned i = 0;  i < numSubjectIds;  ++i) {
-        subjectEntries[i] = obtainSubjectEntryAndIndex(subjectIds[i]);
+        subjectEntries[i]
+            = obtainSubjectEntryAndIndex(subjectIds[i], SH(hashes[i]));
     }
     
+    Id::hashMany(behIds, numBehIds, hashes.data());
     std::vector<BehaviorEntry *> behaviorEntries(numBehIds);
     for (unsigned i = 0;  i < numBehIds;  ++i) {
-        behaviorEntries[i] = obtainBehaviorEntry(behIds[i]);
+        behaviorEntries[i] = obtainBehaviorEntry(behIds[i], BH(hashes[i]));
     }
     
     if (n == 0)
@@ -482,7 +489,19 @@ recordMany(const Id * behIds,
     atomic_min(earliest_, entryMin);
     atomic_max(latest_, entryMax);
 
-    totalEventsRecorded_ += n;
+    // Any root will do for the count; the first subject's is as good as any
+    subjectRoots[subjectEntries.at(first[0].subjIndex).second.root]
+        ->eventsRecorded += n;
+}
+
+int64_t
+MutableBehaviorDomain::
+totalEventsRecorded() const
+{
+    int64_t result = 0;
+    for (auto & r: subjectRoots)
+        result += r->eventsRecorded;
+    return result;
 }
 
 size_t
@@ -1263,13 +1282,18 @@ updatePartialCache()
 MutableBehaviorDomain::BehaviorEntry *
 MutableBehaviorDomain::
 obtainBehaviorEntry(const Id & behavior)
+{
+    return obtainBehaviorEntry(behavior, BH(behavior));
+}
+
+MutableBehaviorDomain::BehaviorEntry *
+MutableBehaviorDomain::
+obtainBehaviorEntry(const Id & behavior, BH behHash)
 {
     // Fast path: we already know the behavior
 
     MutableBehaviorDomain::BehaviorEntry * result = nullptr;
 
-    BH behHash(behavior);
-
     // Look for locally cached version
     ThreadInfo * thrInfo = threadInfo.get();
     if (thrInfo) {
@@ -1361,7 +1385,14 @@ std::pair<MutableBehaviorDomain::SubjectEntry *,
 MutableBehaviorDomain::
 obtainSubjectEntryAndIndex(const Id & subject)
 {
-    SH subjectHash(subject);
+    return obtainSubjectEntryAndIndex(subject, SH(subject));
+}
+
+std::pair<MutableBehaviorDomain::SubjectEntry *,
+          MutableBehaviorDomain::SI2>
+MutableBehaviorDomain::
+obtainSubjectEntryAndIndex(const Id & subject, SH subjectHash)
+{
     int rootNumber = (subjectHash >> 59);
     ExcAssertLess(rootNumber, NUM_SUBJECT_ROOTS);
 
@@ -1371,19 +1402,29 @@ obtainSubjectEntryAndIndex(const Id & subject)
 
     int idx = -1;
 
-    // TODO: why not move this lock down...
+    // Look it up without the lock first.  Writers may be inserting into
+    // the index concurrently, so we could see a half written entry; we
+    // only trust what we found if it leads back to our subject.  Anything
+    // else (including the subject not being there yet) takes the locked
+    // path below, which will find or insert it properly.
+    {
+        auto subjectIndex = subjectRoot.subjectIndexPtr();
+        auto it = subjectIndex->find(subjectHash);
+        if (it != subjectIndex->end()) {
+            uint32_t foundIdx = it->second;
+            auto entries = subjectRoot.subjectEntryPtr();
+            if (foundIdx < entries->size) {
+                SubjectEntry * entry = entries->entries[foundIdx];
+                if (entry && entry->hash == subjectHash)
+                    return make_pair(entry, SI2(rootNumber, foundIdx));
+            }
+        }
+    }
+
     std::unique_lock<IndexLock> guard(subjectRoot.subjectIndexWriteLock);
 
     auto subjectIndex = subjectRoot.subjectIndexPtr();
 
-    auto it = subjectIndex->find(subjectHash);
-    if (it != subjectIndex->end())
-        return make_pair(subjectRoot.subjectEntryPtr()->at(it->second), SI2(rootNumber, it->second));
-    
-    // ... to here?
-    // Answer... it leads to race conditions I haven't fully worked out
-    // yet
-
     {
         
         auto it = subjectIndex->find(subjectHash);
@@ -1442,9 +1483,9 @@ obtainSubjectEntryAndIndex(const Id & subject)
                 //     << endl;
             }
             else {
-                // Simply insert it.  The way this works it won't affect
-                // readers.
-                (*subjectIndex)[subjectHash] = idx;
+                // Simply insert it.  Readers without the lock check what
+                // they find, so a partially written entry is harmless.
+                subjectIndex->insert(make_pair(subjectHash, idx));
             }
             return make_pair(result, SI2(rootNumber, idx));
         }
@@ -281,10 +281,7 @@ struct MutableBehaviorDomain : public BehaviorDomain {
     /** Return an approximation to the size of the data in the file. */
     uint64_t getApproximateFileSize() const;
 
-    virtual int64_t totalEventsRecorded() const
-    {
-        return totalEventsRecorded_;
-    }
+    virtual int64_t totalEventsRecorded() const;
 
     static bool profile;
     static std::atomic<uint64_t> records;
@@ -314,7 +311,6 @@ private:
     // Independent lock for writing to subjectIndex
     std::atomic<double> earliest_, latest_;
     Date nominalStart_, nominalEnd_;
-    std::atomic<uint64_t> totalEventsRecorded_;
 
     std::mutex immutableLock;   ///< Lock to set immutable
     bool immutable_;   ///< If true, no modify operations can be performed
@@ -783,13 +779,20 @@ private:
     struct SubjectRoot {
         SubjectRoot(GcLock & lock)
             : subjectIndexPtr(lock),
-              subjectEntryPtr(lock)
+              subjectEntryPtr(lock),
+              eventsRecorded(0)
         {
         }
 
         mutable IndexLock subjectIndexWriteLock;
         RcuProtected<LightweightHash<uint64_t, uint32_t> > subjectIndexPtr;
         RcuProtected<Root<SubjectEntry> > subjectEntryPtr;
+
+        /// Events recorded for subjects of this root.  Counting per root
+        /// means that concurrent recording threads don't all contend on
+        /// the same counter; it has its own cache line so that it doesn't
+        /// slow down readers of the pointers above.
+        alignas(64) std::atomic<uint64_t> eventsRecorded;
     };
 
     // GC lock for the behavior and subject roots
@@ -813,9 +816,12 @@ private:
 
 
     BehaviorEntry * obtainBehaviorEntry(const Id & behavior);
+    BehaviorEntry * obtainBehaviorEntry(const Id & behavior, BH behHash);
     SubjectEntry * obtainSubjectEntry(const Id & subject);
     std::pair<MutableBehaviorDomain::SubjectEntry *, SI2>
     obtainSubjectEntryAndIndex(const Id & subject);
+    std::pair<MutableBehaviorDomain::SubjectEntry *, SI2>
+    obtainSubjectEntryAndIndex(const Id & subject, SH subjectHash);
 
     const BehaviorEntry * getBehaviorEntry(BH behavior) const;
     const BehaviorEntry * getBehaviorEntry(BI behavior) const;
@@ -379,6 +379,49 @@ BOOST_AUTO_TEST_CASE(test_merge_with_empty_behaviors_serialized)
 }
 #endif
 
+#if 1
+BOOST_AUTO_TEST_CASE(test_merge_behavior_files)
+{
+    auto mut = std::make_shared<MutableBehaviorDomain>();
+    createTestBehaviors(mut);
+
+    // Split the subjects between three files, one of which is empty
+    vector<std::shared_ptr<MutableBehaviorDomain> > parts;
+    for (unsigned i = 0;  i < 3;  ++i) {
+        parts.push_back(std::make_shared<MutableBehaviorDomain>());
+        parts.back()->hasSubjectIds = true;
+    }
+
+    auto onSubject = [&] (SH subject, const SubjectIterInfo &)
+        {
+            auto & part = parts[subject.hash() % 2];
+            Id id = mut->getSubjectId(subject);
+            auto onBeh = [&] (BH beh, Date ts, uint32_t count)
+            {
+                part->record(id, mut->getBehaviorId(beh), ts, count);
+                return true;
+            };
+            mut->forEachSubjectBehaviorHash(subject, onBeh);
+            return true;
+        };
+    mut->forEachSubject(onSubject);
+
+    vector<string> files;
+    for (unsigned i = 0;  i < parts.size();  ++i) {
+        for (auto & md: { "hello", "version" })
+            parts[i]->setFileMetadata(md, mut->getFileMetadata(md));
+        files.push_back("tmp/mergeBehaviorFilesTest" + to_string(i) + ".beh");
+        parts[i]->save(files.back());
+    }
+
+    mergeBehaviorFiles(files, "tmp/mergeBehaviorFilesTest.beh");
+
+    MappedBehaviorDomain merged("tmp/mergeBehaviorFilesTest.beh");
+    testIntegrity(merged);
+    testEquivalent(merged, *mut);
+}
+#endif
+
 #if 1
 BOOST_AUTO_TEST_CASE(test_streams)
 {
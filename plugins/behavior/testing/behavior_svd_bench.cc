@@ -0,0 +1,114 @@
+/* behavior_svd_bench.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Benchmark the training of a behavior SVD.
+*/
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/positional_options.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "mldb/arch/timers.h"
+#include "mldb/plugins/behavior/behavior_manager.h"
+#include "mldb/plugins/behavior/behavior_domain.h"
+#include "mldb/plugins/behavior/behavior_svd.h"
+
+using namespace std;
+namespace po = boost::program_options;
+using namespace MLDB;
+
+int
+main(int argc, char ** argv)
+{
+    string s3CacheDir;
+    vector<string> inputFiles;
+    int numDense = 2000;
+    int numSingularValues = 100;
+    int oversampling = 10;
+    int powerIterations = 2;
+    bool noLongTail = false;
+    bool compare = false;
+
+    po::options_description all_opt;
+    all_opt.add_options()
+        ("s3-cache-directory,C", po::value<string>(&s3CacheDir),
+         "S3 cache directory")
+        ("input-file,i", po::value(&inputFiles),
+         "File to read")
+        ("num-dense,d", po::value(&numDense),
+         "Number of dense behaviors")
+        ("num-singular-values,n", po::value(&numSingularValues),
+         "Number of singular values")
+        ("oversampling,o", po::value(&oversampling),
+         "Oversampling of the randomized range finder")
+        ("power-iterations,p", po::value(&powerIterations),
+         "Power iterations of the randomized range finder")
+        ("no-long-tail", po::value(&noLongTail)->zero_tokens(),
+         "Don't calculate the vectors of the sparse behaviors")
+        ("compare-with-lanczos", po::value(&compare)->zero_tokens(),
+         "Also train with Lanczos over the dense overlaps and compare")
+        ("help,h", "print this message");
+
+    po::positional_options_description pos;
+    pos.add("input-file", -1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv)
+              .options(all_opt)
+              .positional(pos)
+              .run(),
+              vm);
+    po::notify(vm);
+
+    if (vm.count("help") || inputFiles.empty()) {
+        cerr << all_opt << endl;
+        return 1;
+    }
+
+    BehaviorManager behManager;
+    if (!s3CacheDir.empty())
+        behManager.setS3CacheDir(s3CacheDir);
+
+    auto behs = behManager.get(inputFiles);
+    behs->stats();
+
+    auto train = [&] (bool randomized)
+        {
+            BehaviorSvd svd(SH::max(), numDense, numSingularValues,
+                            vector<BH>(), HAMMING, !noLongTail);
+            svd.randomized = randomized;
+            svd.oversampling = oversampling;
+            svd.powerIterations = powerIterations;
+
+            Timer timer;
+            svd.trainNoProgress(*behs);
+            cerr << (randomized ? "randomized" : "lanczos")
+                 << " svd: " << timer.elapsed() << endl;
+            return svd;
+        };
+
+    BehaviorSvd randomized = train(true);
+
+    if (!compare)
+        return 0;
+
+    BehaviorSvd lanczos = train(false);
+
+    cerr << "singular values (randomized, lanczos, relative difference):"
+         << endl;
+    for (int i = 0;  i < numSingularValues;  ++i) {
+        float r = randomized.singularValues.at(i);
+        float l = lanczos.singularValues.at(i);
+        cerr << i << "\t" << r << "\t" << l << "\t"
+             << (l == 0.0 ? 0.0 : fabs(r - l) / l) << endl;
+    }
+
+    return 0;
+}
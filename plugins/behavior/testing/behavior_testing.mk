@@ -23,6 +23,8 @@ $(eval $(call test,tranches_test,behavior,boost))
 $(eval $(call test,mutable_behavior_stress_test,behavior,boost manual))
 $(eval $(call program,mutable_behavior_bench,behavior test_utils utils boost_program_options))
 $(eval $(call program,behavior_domain_read_bench,boost_program_options behavior test_utils))
+$(eval $(call program,behavior_svd_bench,boost_program_options behavior))
 
 $(eval $(call test,id_test,behavior,boost))
 $(eval $(call program,id_profile,behavior))
+$(eval $(call program,id_bench,behavior test_utils boost_program_options))
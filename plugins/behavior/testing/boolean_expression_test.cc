@@ -154,3 +154,48 @@ BOOST_AUTO_TEST_CASE( test_print_sql )
     parsed = BooleanExpression::parse("1");
     BOOST_REQUIRE_EQUAL(parsed->printSql(), "\"1\"");
 }
+
+BOOST_AUTO_TEST_CASE( test_count_subjects )
+{
+    // Enough subjects that the bitmaps span several words
+    MutableBehaviorDomain behs;
+    for (int i = 1;  i <= 1000;  ++i) {
+        Date ts = Date::fromSecondsSinceEpoch(i);
+        if (i % 2 == 0)
+            behs.recordId(Id(i), Id(2), ts, 1);
+        if (i % 3 == 0)
+            behs.recordId(Id(i), Id(3), ts.plusSeconds(1), 1);
+        if (i % 5 == 0)
+            behs.recordId(Id(i), Id(5), ts, 1);
+    }
+    behs.finish();
+
+    auto testCount = [&] (const std::string & expr, bool isSet)
+        {
+            auto parsed = BooleanExpression::parse(expr);
+            BOOST_CHECK_EQUAL(parsed->isSetExpression(), isSet);
+
+            for (SH maxSubject: { SH::max(), SH(uint64_t(-1) / 2) }) {
+                size_t expected
+                    = parsed->generateUnique(behs, maxSubject).size();
+                BOOST_CHECK_EQUAL(parsed->countSubjects(behs, maxSubject),
+                                  expected);
+            }
+        };
+
+    testCount("2", true);
+    testCount("7", true);
+    testCount("(2 AND 3)", true);
+    testCount("(2 OR 3 OR 5)", true);
+    testCount("NOT 5", true);
+    testCount("(2 AND NOT (3 OR 5))", true);
+    testCount("(NOT 2) AND (NOT 3)", true);
+
+    // Time dependent expressions fall back to generate()
+    testCount("TIMES(2,1)", false);
+    testCount("(2 THEN 3)", false);
+    testCount("(2 AND (3 THEN 5))", false);
+
+    BOOST_CHECK_EQUAL(BooleanExpression::parse("(2 AND 3)")
+                      ->countSubjects(behs), 166);
+}
@@ -0,0 +1,145 @@
+/* id_bench.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Benchmark parsing and hashing of the kinds of Id that subjects have.
+*/
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "mldb/utils/testing/benchmarks.h"
+#include "mldb/plugins/behavior/id.h"
+#include "mldb/types/path.h"
+
+using namespace std;
+namespace po = boost::program_options;
+using namespace MLDB;
+
+vector<string>
+generateIds(const string & kind, size_t n, mt19937 & rng)
+{
+    auto randomChars = [&] (size_t len, const char * chars, size_t numChars)
+        {
+            string result(len, ' ');
+            for (auto & c: result)
+                c = chars[rng() % numChars];
+            return result;
+        };
+
+    vector<string> result;
+    result.reserve(n);
+
+    for (size_t i = 0;  i < n;  ++i) {
+        string s;
+        if (kind == "uuid") {
+            s = randomChars(36, "0123456789abcdef", 16);
+            s[8] = s[13] = s[18] = s[23] = '-';
+        }
+        else if (kind == "hex") {
+            s = randomChars(32, "0123456789abcdef", 16);
+        }
+        else if (kind == "bigdec") {
+            s = to_string(rng() * (uint64_t)rng() + 1000000000000);
+        }
+        else if (kind == "shortstr") {
+            s = "user" + randomChars(12, "abcdefghijklmnopqrstuvwxyz", 26);
+        }
+        else if (kind == "str") {
+            s = "user:" + randomChars(40, "abcdefghijklmnopqrstuvwxyz", 26);
+        }
+        else throw MLDB::Exception("unknown id kind " + kind);
+        result.emplace_back(std::move(s));
+    }
+
+    return result;
+}
+
+int
+main(int argc, char ** argv)
+{
+    size_t numIds = 1000000;
+    int numIterations = 5;
+    vector<string> kinds = { "uuid", "hex", "bigdec", "shortstr", "str" };
+
+    po::options_description all_opt;
+    all_opt.add_options()
+        ("num-ids,n", po::value(&numIds),
+         "Number of ids of each kind")
+        ("iterations,i", po::value(&numIterations),
+         "Number of times to run each benchmark")
+        ("kind,k", po::value(&kinds),
+         "Kind of id to benchmark (uuid, hex, bigdec, shortstr, str)")
+        ("help,h", "print this message");
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv)
+              .options(all_opt)
+              .run(),
+              vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        cerr << all_opt << endl;
+        return 1;
+    }
+
+    mt19937 rng(1);
+    Benchmarks bms;
+
+    for (auto & kind: kinds) {
+        vector<string> strings = generateIds(kind, numIds, rng);
+        vector<Id> ids(numIds);
+        vector<uint64_t> hashes(numIds);
+        uint64_t total = 0;
+
+        for (int it = 0;  it < numIterations;  ++it) {
+            {
+                Benchmark bm(bms, kind + "-parse");
+                for (size_t i = 0;  i < numIds;  ++i)
+                    ids[i].parse(strings[i]);
+            }
+            {
+                Benchmark bm(bms, kind + "-toString");
+                for (auto & id: ids)
+                    total += id.toString().size();
+            }
+            {
+                Benchmark bm(bms, kind + "-hash");
+                for (auto & id: ids)
+                    total += id.hash();
+            }
+            {
+                Benchmark bm(bms, kind + "-hashMany");
+                Id::hashMany(ids.data(), numIds, hashes.data());
+            }
+            {
+                // What hash() used to do; it must give the same answer
+                Benchmark bm(bms, kind + "-pathHash");
+                for (auto & id: ids)
+                    total += Path(id.toUtf8String()).hash();
+            }
+        }
+
+        for (size_t i = 0;  i < numIds;  ++i) {
+            if (hashes[i] != Path(ids[i].toUtf8String()).hash())
+                throw MLDB::Exception("hash of " + ids[i].toString()
+                                      + " doesn't match its path hash");
+        }
+
+        cerr << kind << ": type " << (int)Id(strings[0]).type << " checksum "
+             << total << endl;
+    }
+
+    cerr << "total times for " << numIterations << " iterations over "
+         << numIds << " ids of each kind:" << endl;
+    bms.dumpTotals();
+
+    return 0;
+}
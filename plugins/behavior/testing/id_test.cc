@@ -16,6 +16,7 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/utils/string_functions.h"
 #include "mldb/types/value_description.h"
+#include "mldb/types/path.h"
 
 using namespace std;
 using namespace MLDB;
@@ -514,3 +515,66 @@ BOOST_AUTO_TEST_CASE( test_default_description_parse_id_128_str )
 
     BOOST_CHECK_EQUAL(expected, result);
 }
+
+/* The hash of an Id must be the same as the hash of the Path made from its
+   string, whichever way it is stored, and hashMany() must agree with it. */
+BOOST_AUTO_TEST_CASE( test_id_hash_matches_path_hash )
+{
+    vector<Id> ids = {
+        Id(""), Id("null"), Id("0"), Id("12345678901234567"),
+        Id("88962710306127693105141072481996271"),
+        Id("0828398c-5965-11e0-84c8-0026b937c8e1"),
+        Id("0828398C-5965-11E0-84C8-0026B937C8E1"),
+        Id("0828398c-5965-11E0-84c8-0026b937c8e1"),  // mixed case: a string
+        Id("CAESEAYra3NIxLT9C8twKrzqaA"),
+        Id("JTzfCLBhlbWSsdZj"),
+        Id("0123456789abcdef0123456789ABCDEF"),
+        Id("short"), Id("a longer string which is on the heap"),
+        Id("h\xc3\xa9llo"), Id("h\xc3\xa9llo, on the heap this time"),
+        Id(Id("compound"), Id("0828398c-5965-11e0-84c8-0026b937c8e1"))
+    };
+
+    for (auto & id: ids) {
+        BOOST_CHECK_EQUAL(id.hash(), Path(id.toUtf8String()).hash());
+    }
+
+    vector<uint64_t> hashes(ids.size());
+    Id::hashMany(ids.data(), ids.size(), hashes.data());
+    for (unsigned i = 0;  i < ids.size();  ++i) {
+        BOOST_CHECK_EQUAL(hashes[i], ids[i].hash());
+    }
+}
+
+/* Every digit position of the hex based types is parsed and printed back. */
+BOOST_AUTO_TEST_CASE( test_hex_id_digits )
+{
+    const char * digits = "0123456789abcdef";
+    for (unsigned i = 0;  i < 32;  ++i) {
+        for (unsigned d = 0;  d < 16;  ++d) {
+            string hex(32, 'f');
+            hex[i] = digits[d];
+            Id id(hex);
+            BOOST_CHECK_EQUAL(id.type, Id::HEX128LC);
+            BOOST_CHECK_EQUAL(id.toString(), hex);
+
+            string uuid = hex.substr(0, 8) + "-" + hex.substr(8, 4) + "-"
+                + hex.substr(12, 4) + "-" + hex.substr(16, 4) + "-"
+                + hex.substr(20, 12);
+            Id id2(uuid);
+            BOOST_CHECK_EQUAL(id2.type, Id::UUID);
+            BOOST_CHECK_EQUAL(id2.toString(), uuid);
+
+            // Anything else in that position makes it a string
+            uuid[uuid.size() - 1 - i] = 'g';
+            BOOST_CHECK_EQUAL(Id(uuid).type, Id::STR);
+        }
+    }
+
+    for (unsigned len = 1;  len < 39;  ++len) {
+        string dec(len, '7');
+        Id id(dec);
+        BOOST_CHECK_EQUAL(id.type, Id::BIGDEC);
+        BOOST_CHECK_EQUAL(id.toString(), dec);
+        BOOST_CHECK_EQUAL(id.toStringLength(), len);
+    }
+}
@@ -14,6 +14,8 @@
 #include "mldb/utils/testing/fixtures.h"
 #include "mldb/plugins/behavior/mapped_behavior_domain.h"
 #include "mldb/plugins/behavior/mutable_behavior_domain.h"
+#include "mldb/plugins/behavior/lazy_remote_file.h"
+#include "mldb/vfs/fs_utils.h"
 
 
 using namespace std;
@@ -77,3 +79,183 @@ BOOST_AUTO_TEST_CASE(test_getSubjectIndex)
     idx = mappedBeh.getSubjectIndex(sh);
     BOOST_CHECK_EQUAL(idx, SI(-1));
 }
+
+/* Test that intersecting and uniting the subject lists of several
+ * behaviors gives the same answer as the generic implementation, both
+ * where the lists are galloped through and where they're merged. */
+BOOST_AUTO_TEST_CASE(test_intersect_and_union_behaviors)
+{
+    TestFolderFixture fixture("mapped_beh_intersect");
+    string filename("mapped-beh_intersect");
+
+    // Behavior "every<n>" is had by every n-th subject, so that the
+    // lists range from very long to very short
+    vector<int> strides = { 1, 2, 3, 7, 50, 1000 };
+
+    MutableBehaviorDomain mutableBeh;
+    for (int i = 0;  i < 20000;  ++i) {
+        Id subject("s" + to_string(i));
+        for (int stride: strides) {
+            if (i % stride == 0)
+                mutableBeh.record(subject, Id("every" + to_string(stride)),
+                                  Date::fromSecondsSinceEpoch(i));
+        }
+    }
+    mutableBeh.save(filename);
+
+    MappedBehaviorDomain mappedBeh(filename);
+
+    auto beh = [] (int stride) { return BH(Id("every" + to_string(stride))); };
+
+    vector<vector<BH> > queries = {
+        { beh(2), beh(3) },                  // similar lengths: merged
+        { beh(1000), beh(1), beh(2) },       // very different: galloped
+        { beh(7), beh(50), beh(3), beh(2) },
+        { beh(50) },
+        { beh(3), BH(Id("unknown")) },
+        {}
+    };
+
+    for (auto & query: queries) {
+        vector<SH> expectedAll
+            = mutableBeh.getSubjectsWithAllBehaviors(query);
+        vector<SH> expectedAny
+            = mutableBeh.getSubjectsWithAnyBehavior(query);
+
+        BOOST_CHECK(mappedBeh.getSubjectsWithAllBehaviors(query)
+                    == expectedAll);
+        BOOST_CHECK(mappedBeh.getSubjectsWithAnyBehavior(query)
+                    == expectedAny);
+
+        // Check against the definition as well
+        size_t numAll = 0, numAny = 0;
+        for (int i = 0;  i < 20000;  ++i) {
+            int numHad = 0;
+            for (BH b: query) {
+                for (int stride: strides) {
+                    if (b == beh(stride) && i % stride == 0)
+                        ++numHad;
+                }
+            }
+            numAll += !query.empty() && numHad == query.size();
+            numAny += numHad > 0;
+        }
+        BOOST_CHECK_EQUAL(expectedAll.size(), numAll);
+        BOOST_CHECK_EQUAL(expectedAny.size(), numAny);
+    }
+
+    // Limiting the subjects gives a prefix of the full answer
+    vector<SH> all = mappedBeh.getSubjectsWithAllBehaviors({ beh(2), beh(3) });
+    BOOST_REQUIRE(all.size() > 10);
+    vector<SH> prefix
+        = mappedBeh.getSubjectsWithAllBehaviors({ beh(2), beh(3) }, all[9]);
+    BOOST_CHECK(prefix == vector<SH>(all.begin(), all.begin() + 10));
+}
+
+/* Test that the subjects that had a behavior within a time range are the
+ * same when they come from the time index as when they're scanned for,
+ * for ranges both aligned and not aligned with its buckets. */
+BOOST_AUTO_TEST_CASE(test_time_index)
+{
+    TestFolderFixture fixture("mapped_beh_time_index");
+    string filename("mapped-beh_time_index");
+    string noIndexFilename("mapped-beh_no_time_index");
+
+    const double day = 86400;
+    Date start = Date::fromSecondsSinceEpoch(1000 * day);
+
+    // Subject i has "visit" every (i % 7 + 1) days at (i % 24) hours, and
+    // "buy" once on day i % 30
+    MutableBehaviorDomain mutableBeh;
+    for (int i = 0;  i < 2100;  ++i) {
+        Id subject("s" + to_string(i));
+        for (int d = 0;  d < 30;  d += i % 7 + 1)
+            mutableBeh.record(subject, Id("visit"),
+                              start.plusSeconds(d * day + (i % 24) * 3600));
+        mutableBeh.record(subject, Id("buy"),
+                          start.plusSeconds((i % 30) * day + 60));
+    }
+    mutableBeh.save(noIndexFilename);
+    mutableBeh.timeIndexBucketSeconds = day;
+    mutableBeh.save(filename);
+
+    MappedBehaviorDomain mappedBeh(filename);
+    MappedBehaviorDomain noIndexBeh(noIndexFilename);
+    BOOST_CHECK(mappedBeh.hasTimeIndex());
+    BOOST_CHECK(!noIndexBeh.hasTimeIndex());
+
+    vector<pair<Date, Date> > ranges = {
+        { start, start.plusSeconds(30 * day) },                // everything
+        { start.plusSeconds(23 * day), start.plusSeconds(30 * day) },  // days
+        { start.plusSeconds(3 * day + 7200),                   // part days
+          start.plusSeconds(5 * day + 3600) },
+        { start.plusSeconds(10 * day + 3600),                  // within a day
+          start.plusSeconds(10 * day + 7200) },
+        { start.plusSeconds(-5 * day), start.plusSeconds(-day) },  // before
+        { start.plusSeconds(4 * day), start.plusSeconds(4 * day) } // empty
+    };
+
+    for (BH beh: { BH(Id("visit")), BH(Id("buy")), BH(Id("unknown")) }) {
+        for (auto & range: ranges) {
+            vector<SH> expected
+                = mutableBeh.getSubjectsWithBehaviorBetween
+                    (beh, range.first, range.second);
+            BOOST_CHECK(mappedBeh.getSubjectsWithBehaviorBetween
+                        (beh, range.first, range.second) == expected);
+            BOOST_CHECK(noIndexBeh.getSubjectsWithBehaviorBetween
+                        (beh, range.first, range.second) == expected);
+        }
+    }
+
+    // Check one against the definition as well
+    vector<SH> bought
+        = mappedBeh.getSubjectsWithBehaviorBetween
+            (BH(Id("buy")), start.plusSeconds(23 * day),
+             start.plusSeconds(30 * day));
+    BOOST_CHECK_EQUAL(bought.size(), 7 * 70);
+}
+
+/* Test that a file that is paged in on demand gives the same answers as
+ * the same file mapped in full, and that opening it doesn't read it all. */
+BOOST_AUTO_TEST_CASE(test_lazy_remote_file)
+{
+    TestFolderFixture fixture("mapped_beh_lazy");
+    string filename("mapped-beh_lazy");
+
+    MutableBehaviorDomain mutableBeh;
+    for (int i = 0;  i < 20000;  ++i) {
+        Id subject("subject" + to_string(i));
+        for (int j = 0;  j < i % 13;  ++j) {
+            mutableBeh.record(subject, Id("beh" + to_string((i * j) % 500)),
+                              Date::fromSecondsSinceEpoch(i + j));
+        }
+    }
+    mutableBeh.save(filename);
+
+    MappedBehaviorDomain fullBeh(filename);
+
+    uint64_t size = getUriObjectInfo(filename).size;
+    auto remote = std::make_shared<LazyRemoteFile>
+        (filename, size, "" /* temporary */, 4096 /* chunk size */,
+         2 /* prefetch chunks */);
+    MappedBehaviorDomain lazyBeh(remote->buffer(), remote);
+
+    // Only the indexes have been read
+    BOOST_CHECK_LT(remote->bytesDownloaded(), size);
+    BOOST_CHECK_LT(remote->numResidentChunks(), remote->numChunks());
+
+    auto subjects = fullBeh.allSubjectHashes(SH(-1), true);
+    BOOST_CHECK(lazyBeh.allSubjectHashes(SH(-1), true) == subjects);
+
+    for (BH beh: fullBeh.allBehaviorHashes(true)) {
+        BOOST_CHECK(lazyBeh.getSubjectHashesAndTimestamps(beh)
+                    == fullBeh.getSubjectHashesAndTimestamps(beh));
+    }
+
+    for (SH subject: subjects) {
+        BOOST_CHECK(lazyBeh.getSubjectBehaviorCounts(subject)
+                    == fullBeh.getSubjectBehaviorCounts(subject));
+        BOOST_CHECK_EQUAL(lazyBeh.getSubjectId(subject),
+                          fullBeh.getSubjectId(subject));
+    }
+}
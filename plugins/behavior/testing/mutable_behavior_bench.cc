@@ -30,11 +30,60 @@ genIds(int numIds)
     return ids;
 }
 
+/* Record every behavior for every subject into a fresh domain, splitting the
+   subjects between the given number of threads.  Returns the elapsed time in
+   seconds. */
+double
+record(const vector<Id> & subjects,
+       const vector<MutableBehaviorDomain::ManyEntryId> & behEntries,
+       int nThreads, Benchmarks & bms)
+{
+    int numSubjects = subjects.size();
+    int numBehs = behEntries.size();
+
+    MutableBehaviorDomain behDom;
+    int sliceSize = numSubjects / nThreads;
+    if (sliceSize * nThreads < numSubjects) {
+        sliceSize++;
+    }
+
+    auto populate = [&] (int threadNum) {
+        Benchmark bm(bms, "record-" + to_string(threadNum));
+        int start = threadNum * sliceSize;
+        int end = min(start + sliceSize, numSubjects);
+        for (int i = start; i < end; i++) {
+            const Id & subject = subjects[i];
+            behDom.recordMany(subject, &behEntries[0], numBehs);
+        }
+    };
+
+    Date before = Date::now();
+    {
+        Benchmark bm(bms, "record");
+
+        vector<thread> threads;
+        for (int i = 1; i < nThreads; i++) {
+            threads.emplace_back(populate, i);
+        }
+
+        std::atomic_thread_fence(std::memory_order_release);
+
+        populate(0);
+
+        for (auto & th: threads) {
+            th.join();
+        }
+    }
+
+    return Date::now().secondsSince(before);
+}
+
 int main(int argc, char * argv[])
 {
     int nThreads(1);
     int numSubjects(1);
     int numBehs(1);
+    bool scaling(false);
 
     {
         using namespace boost::program_options;
@@ -47,6 +96,8 @@ int main(int argc, char * argv[])
              "default: 1")
             ("num-behaviors,b", value(&numBehs),
              "default: 1")
+            ("scaling", bool_switch(&scaling),
+             "report throughput for 1, 2, 4... up to num-threads threads")
             ("help,H", "show help");
 
         if (argc == 1) {
@@ -74,12 +125,6 @@ int main(int argc, char * argv[])
     vector<Id> subjects = genIds(numSubjects);
     vector<Id> behaviors = genIds(numBehs);
 
-    MutableBehaviorDomain behDom;
-    int sliceSize = numSubjects / nThreads;
-    if (sliceSize * nThreads < numSubjects) {
-        sliceSize++;
-    }
-
     vector<MutableBehaviorDomain::ManyEntryId> behEntries(numBehs);
     Date behDate = Date::now();
     for (int i = 0; i < numBehs; i++) {
@@ -90,35 +135,26 @@ int main(int argc, char * argv[])
     }
     
     Benchmarks bms;
-    
-    auto populate = [&] (int threadNum) {
-        Benchmark bm(bms, "record-" + to_string(threadNum));
-        int start = threadNum * sliceSize;
-        int end = min(start + sliceSize, numSubjects);
-        for (int i = start; i < end; i++) {
-            const Id & subject = subjects[i];
-            behDom.recordMany(subject, &behEntries[0], numBehs);
-        }
-    };
-
-    {
-        Benchmark bm(bms, "record");
-
-        vector<thread> threads;
-        for (int i = 1; i < nThreads; i++) {
-            threads.emplace_back(populate, i);
-        }
 
-        std::atomic_thread_fence(std::memory_order_release);
-
-        populate(0);
-
-        for (auto & th: threads) {
-            th.join();
-        }
+    if (!scaling) {
+        record(subjects, behEntries, nThreads, bms);
+        bms.dumpTotals();
+        return 0;
     }
 
-    bms.dumpTotals();
+    // Scaling curve: events per second and speedup over one thread
+    double numEvents = 1.0 * numSubjects * numBehs;
+    double baseline = 0.0;
+    cout << "threads events/s speedup" << endl;
+    for (int n = 1;;  n = min(n * 2, nThreads)) {
+        double elapsed = record(subjects, behEntries, n, bms);
+        double rate = numEvents / elapsed;
+        if (n == 1)
+            baseline = rate;
+        cout << n << " " << rate << " " << rate / baseline << endl;
+        if (n == nThreads)
+            break;
+    }
 
     return 0;
 }
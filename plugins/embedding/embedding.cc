@@ -9,6 +9,7 @@
 
 #include "embedding.h"
 #include "mldb/utils/vantage_point_tree.h"
+#include "mldb/utils/hnsw_index.h"
 #include "mldb/arch/rcu_protected.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/arch/simd_vector.h"
@@ -17,7 +18,9 @@
 #include "mldb/sql/sql_expression.h"
 #include "mldb/types/tuple_description.h"
 #include "mldb/types/structure_description.h"
+#include "mldb/types/enum_description.h"
 #include "mldb/types/vector_description.h"
+#include "mldb/types/distribution_description.h"
 #include "mldb/types/set_description.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/types/any_impl.h"
@@ -58,6 +61,39 @@ operator >> (MLDB::DB::Store_Reader & store, Path & coords);
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+DEFINE_ENUM_DESCRIPTION(EmbeddingIndex);
+
+EmbeddingIndexDescription::
+EmbeddingIndexDescription()
+{
+    addValue("vpTree", EMBEDDING_INDEX_VP_TREE,
+             "Vantage point tree, which returns the exact nearest neighbors. "
+             "It is rebuilt from scratch on each commit, and queries become "
+             "slow for high-dimensional embeddings.");
+    addValue("hnsw", EMBEDDING_INDEX_HNSW,
+             "Hierarchical Navigable Small World graph, which returns "
+             "approximate nearest neighbors much faster, especially for "
+             "high-dimensional embeddings.  Rows are added to the graph as "
+             "they are recorded.");
+}
+
+DEFINE_ENUM_DESCRIPTION(EmbeddingStorage);
+
+EmbeddingStorageDescription::
+EmbeddingStorageDescription()
+{
+    addValue("float32", EMBEDDING_STORAGE_FLOAT32,
+             "Store each value as a 32 bit floating point number, exactly "
+             "as it was recorded.");
+    addValue("float16", EMBEDDING_STORAGE_FLOAT16,
+             "Store each value as a 16 bit floating point number, with "
+             "around 3 significant digits.  Values must be less than 65504 "
+             "in magnitude.");
+    addValue("int8", EMBEDDING_STORAGE_INT8,
+             "Store each value in 8 bits, as one of 256 evenly spaced "
+             "values between the minimum and maximum of its row.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
 
 EmbeddingDatasetConfigDescription::
@@ -71,6 +107,60 @@ EmbeddingDatasetConfigDescription()
              "good for normalized embeddings like the SVD) and 'euclidean' "
              "(which is good for geometric embeddings like the t-SNE "
              "algorithm).", METRIC_EUCLIDEAN);
+    addField("index", &EmbeddingDatasetConfig::index,
+             "Index used for nearest neighbors calculations.  Options are "
+             "'vpTree' (exact) and 'hnsw' (approximate, and much faster for "
+             "large or high-dimensional embeddings).",
+             EMBEDDING_INDEX_VP_TREE);
+    addField("hnswM", &EmbeddingDatasetConfig::hnswM,
+             "Number of neighbors each row is linked to in the 'hnsw' index "
+             "(twice this on the bottom level).  Higher values improve "
+             "recall for high-dimensional embeddings, at the cost of memory "
+             "and of slower insertions and queries.", 16);
+    addField("hnswEfConstruction", &EmbeddingDatasetConfig::hnswEfConstruction,
+             "Number of candidate neighbors considered when a row is "
+             "inserted into the 'hnsw' index.  Higher values build a better "
+             "graph, but make recording slower.", 200);
+    addField("hnswEfSearch", &EmbeddingDatasetConfig::hnswEfSearch,
+             "Number of candidate neighbors considered by a query on the "
+             "'hnsw' index; it is raised to the number of neighbors asked "
+             "for if that is higher.  Higher values improve recall at the "
+             "cost of latency.", 64);
+    addField("storage", &EmbeddingDatasetConfig::storage,
+             "Precision with which the coordinates are stored.  'float16' "
+             "and 'int8' use respectively half and a quarter of the memory "
+             "of 'float32', and the values read back from the dataset and "
+             "used for distances are the rounded ones.",
+             EMBEDDING_STORAGE_FLOAT32);
+    addField("pqSubspaces", &EmbeddingDatasetConfig::pqSubspaces,
+             "If non-zero, the coordinates of each row are also encoded "
+             "with a product quantizer with this many subspaces, taking one "
+             "byte each.  Nearest neighbor queries then find candidates "
+             "with the approximate distances from the encoded rows, and "
+             "re-rank them with the stored coordinates.  The quantizer is "
+             "trained on the first commit.", 0);
+    addField("pqRerank", &EmbeddingDatasetConfig::pqRerank,
+             "Number of candidates per neighbor asked for that are "
+             "re-ranked when `pqSubspaces` is set.  Higher values give "
+             "better recall at the cost of latency.", 4);
+
+    onPostValidate = [] (EmbeddingDatasetConfig * config,
+                         JsonParsingContext & context)
+        {
+            if (config->hnswM < 2)
+                throw AnnotatedException
+                    (400, "The embedding dataset `hnswM` parameter must be "
+                     "at least 2");
+            if (config->hnswEfConstruction < 1 || config->hnswEfSearch < 1)
+                throw AnnotatedException
+                    (400, "The embedding dataset `hnswEfConstruction` and "
+                     "`hnswEfSearch` parameters must be at least 1");
+            if (config->pqSubspaces < 0 || config->pqRerank < 1)
+                throw AnnotatedException
+                    (400, "The embedding dataset `pqSubspaces` parameter "
+                     "must not be negative, and `pqRerank` must be at "
+                     "least 1");
+        };
 }
 
 
@@ -78,32 +168,456 @@ EmbeddingDatasetConfigDescription()
 /* EMBEDDING INTERNAL REPRESENTATION                                         */
 /*****************************************************************************/
 
+namespace {
+
+/** Round to the nearest IEEE half precision value.  Values too large in
+    magnitude become infinite.
+*/
+uint16_t floatToHalf(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+
+    uint32_t sign = (x >> 16) & 0x8000;
+    int floatExponent = (x >> 23) & 0xff;
+    uint32_t mantissa = x & 0x7fffff;
+
+    if (floatExponent == 0xff)  // infinity or nan
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+
+    int exponent = floatExponent - 127 + 15;
+    if (exponent >= 31)
+        return sign | 0x7c00;
+
+    if (exponent <= 0) {
+        // Subnormal half, or zero
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t result = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (result & 1)))
+            ++result;
+        return sign | result;
+    }
+
+    // Rounding up may carry into the exponent, which gives the right answer
+    uint32_t result = sign | (exponent << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (result & 1)))
+        ++result;
+    return result;
+}
+
+float halfToFloat(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    int exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t x;
+
+    if (exponent == 0) {
+        if (mantissa == 0)
+            x = sign;
+        else {
+            // Subnormal; normalize it
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                --exponent;
+            }
+            x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    }
+    else if (exponent == 31)
+        x = sign | 0x7f800000 | (mantissa << 13);
+    else x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+
+    float result;
+    memcpy(&result, &x, sizeof(result));
+    return result;
+}
+
+} // file scope
+
 struct EmbeddingDatasetRepr {
-    EmbeddingDatasetRepr(MetricSpace metric)
-        : vpTree(new MLDB::VantagePointTreeT<int>()),
-          distance(DistanceMetric::create(metric))
+    EmbeddingDatasetRepr(const EmbeddingDatasetConfig & config)
+        : config(config),
+          vpTree(new MLDB::VantagePointTreeT<int>()),
+          distance(DistanceMetric::create(config.metric))
     {
+        createHnsw();
     }
 
     EmbeddingDatasetRepr(std::vector<ColumnPath> columnNames,
-                         MetricSpace metric)
-        : columnNames(std::move(columnNames)), columns(this->columnNames.size()),
+                         const EmbeddingDatasetConfig & config)
+        : config(config),
+          columnNames(std::move(columnNames)), columns(this->columnNames.size()),
           vpTree(new MLDB::VantagePointTreeT<int>()),
-          distance(DistanceMetric::create(metric))
+          distance(DistanceMetric::create(config.metric))
     {
         for (unsigned i = 0;  i < this->columnNames.size();  ++i) {
             columnIndex[this->columnNames[i]] = i;
         }
+        createHnsw();
     }
 
     EmbeddingDatasetRepr(const EmbeddingDatasetRepr & other)
-        : columnNames(other.columnNames),
+        : config(other.config),
+          columnNames(other.columnNames),
           columns(other.columns),
           columnIndex(other.columnIndex),
           rows(other.rows),
           rowIndex(other.rowIndex),
-          vpTree(MLDB::VantagePointTreeT<int>::deepCopy(other.vpTree.get()))
+          quantized(other.quantized),
+          pq(other.pq),
+          pqCodes(other.pqCodes),
+          vpTree(MLDB::VantagePointTreeT<int>::deepCopy(other.vpTree.get())),
+          distance(DistanceMetric::create(config.metric))
+    {
+        // The distance metric caches information about each row, which
+        // needs to be there for rows recorded into the copy
+        distribution<float> coords;
+        for (unsigned i = 0;  i < rows.size();  ++i)
+            distance->addRow(i, getCoords(i, coords));
+        if (other.hnsw)
+            hnsw.reset(new HnswIndexT<int>(*other.hnsw));
+    }
+
+    void createHnsw()
+    {
+        if (config.index == EMBEDDING_INDEX_HNSW) {
+            hnsw.reset(new HnswIndexT<int>(config.hnswM,
+                                           config.hnswEfConstruction));
+        }
+    }
+
+    /** Add the given (already recorded) row to the index, if it is built
+        incrementally.  If it throws, the index is unchanged.
+    */
+    void indexRow(int row)
+    {
+        if (!hnsw)
+            return;
+        hnsw->insert(row, [&] (int row1, int row2) { return dist(row1, row2); });
+    }
+
+    /** Record a row, adding it to the distance metric and to the index if
+        that is built incrementally.  If it throws, the row isn't recorded.
+    */
+    void addRow(RowPath rowName, distribution<float> coords, Date timestamp)
+    {
+        size_t rowNum = rows.size();
+
+        try {
+            if (config.storage == EMBEDDING_STORAGE_FLOAT32) {
+                rows.emplace_back(std::move(rowName), std::move(coords),
+                                  timestamp);
+                distance->addRow(rowNum, rows.back().coords);
+            }
+            else {
+                // The metric needs to see the values as they are stored
+                quantized.resize((rowNum + 1) * bytesPerRow());
+                uint8_t * data = &quantized[rowNum * bytesPerRow()];
+                encodeRow(coords, data);
+                decodeRow(data, coords);
+                rows.emplace_back(std::move(rowName), distribution<float>(),
+                                  timestamp);
+                distance->addRow(rowNum, coords);
+            }
+
+            indexRow(rowNum);
+        } catch (const std::exception & exc) {
+            if (rows.size() > rowNum)
+                rows.pop_back();
+            quantized.resize(rowNum * bytesPerRow());
+            throw;
+        }
+    }
+
+    /** Number of bytes in quantized used by each row. */
+    size_t bytesPerRow() const
+    {
+        switch (config.storage) {
+        case EMBEDDING_STORAGE_FLOAT32:
+            return 0;
+        case EMBEDDING_STORAGE_FLOAT16:
+            return 2 * columnNames.size();
+        case EMBEDDING_STORAGE_INT8:
+            // Offset and scale, then one byte per value
+            return 2 * sizeof(float) + columnNames.size();
+        }
+        throw MLDB::Exception("Unknown embedding storage");
+    }
+
+    void encodeRow(const distribution<float> & coords, uint8_t * data) const
+    {
+        for (float c: coords) {
+            if (!isfinite(c))
+                throw AnnotatedException
+                    (400, "Embedding dataset values must be finite",
+                     "coords", coords);
+        }
+
+        if (config.storage == EMBEDDING_STORAGE_FLOAT16) {
+            for (size_t i = 0;  i < coords.size();  ++i) {
+                uint16_t h = floatToHalf(coords[i]);
+                if (!isfinite(halfToFloat(h)))
+                    throw AnnotatedException
+                        (400, "Value is too large for the float16 storage of "
+                         "the embedding dataset",
+                         "value", coords[i]);
+                memcpy(data + 2 * i, &h, sizeof(h));
+            }
+            return;
+        }
+
+        ExcAssertEqual(config.storage, EMBEDDING_STORAGE_INT8);
+        float lowest = 0.0, highest = 0.0;
+        if (!coords.empty())
+            SIMD::vec_min_max(coords.data(), coords.size(), lowest, highest);
+        float scale = (highest - lowest) / 255;
+        memcpy(data, &lowest, sizeof(float));
+        memcpy(data + sizeof(float), &scale, sizeof(float));
+        data += 2 * sizeof(float);
+
+        for (size_t i = 0;  i < coords.size();  ++i) {
+            int code = scale == 0.0 ? 0 : lrintf((coords[i] - lowest) / scale);
+            data[i] = std::min(std::max(code, 0), 255);
+        }
+    }
+
+    void decodeRow(const uint8_t * data, distribution<float> & coords) const
+    {
+        coords.resize(columnNames.size());
+
+        if (config.storage == EMBEDDING_STORAGE_FLOAT16) {
+            SIMD::vec_half_to_float((const uint16_t *)data, coords.data(),
+                                    coords.size());
+            return;
+        }
+
+        ExcAssertEqual(config.storage, EMBEDDING_STORAGE_INT8);
+        float lowest, scale;
+        memcpy(&lowest, data, sizeof(float));
+        memcpy(&scale, data + sizeof(float), sizeof(float));
+        data += 2 * sizeof(float);
+
+        SIMD::vec_dequantize(data, lowest, scale, coords.data(),
+                             coords.size());
+    }
+
+    /** Return the coordinates of the given row, decoding them into
+        storage if they are quantized.
+    */
+    const distribution<float> &
+    getCoords(unsigned row, distribution<float> & storage) const
+    {
+        if (config.storage == EMBEDDING_STORAGE_FLOAT32)
+            return rows[row].coords;
+        decodeRow(&quantized[row * bytesPerRow()], storage);
+        return storage;
+    }
+
+    /** Return the values of the given column for all rows, extracting them
+        into storage if they aren't kept by column.
+    */
+    const std::vector<float> &
+    columnValues(int column, std::vector<float> & storage) const
+    {
+        if (config.storage == EMBEDDING_STORAGE_FLOAT32)
+            return columns.at(column);
+
+        storage.resize(rows.size());
+        distribution<float> coords;
+        for (size_t i = 0;  i < rows.size();  ++i)
+            storage[i] = getCoords(i, coords).at(column);
+        return storage;
+    }
+
+    /** Encode the rows that don't yet have product quantization codes,
+        training the quantizer first if it hasn't been.
+    */
+    void encodePq()
+    {
+        if (config.pqSubspaces == 0 || rows.empty())
+            return;
+
+        // Rows are decoded into a single buffer, so that those used for
+        // training stay available
+        size_t numDims = columnNames.size();
+        size_t firstRow = pq.trained() ? pqCodes.size() / pq.numSubspaces : 0;
+        size_t numRows = rows.size() - firstRow;
+
+        auto getRowCoords = [&] (size_t i, float * out)
+            {
+                distribution<float> storage;
+                const distribution<float> & coords
+                    = getCoords(firstRow + i, storage);
+                std::copy(coords.begin(), coords.end(), out);
+            };
+
+        if (!pq.trained()) {
+            // Train on an evenly spaced sample of the rows
+            static constexpr size_t MAX_TRAINING_ROWS = 16384;
+            size_t numSamples = std::min(numRows, MAX_TRAINING_ROWS);
+            std::vector<float> sampleCoords(numSamples * numDims);
+            std::vector<const float *> sample(numSamples);
+
+            for (size_t i = 0;  i < numSamples;  ++i) {
+                getRowCoords(i * numRows / numSamples,
+                             &sampleCoords[i * numDims]);
+                sample[i] = &sampleCoords[i * numDims];
+            }
+
+            pq.train(sample, numDims, config.pqSubspaces);
+        }
+
+        pqCodes.resize(rows.size() * pq.numSubspaces);
+
+        auto encodePqRow = [&] (size_t i)
+            {
+                std::vector<float> coords(numDims);
+                getRowCoords(i, coords.data());
+                pq.encode(coords.data(),
+                          &pqCodes[(firstRow + i) * pq.numSubspaces]);
+            };
+
+        parallelMap(0, numRows, encodePqRow);
+    }
+
+    /** Return the closest numNeighbors rows within maxDistance of the
+        query, whose exact distance to a row is given by queryDist.  When
+        the rows are product quantized, the candidates are found using the
+        codes and then re-ranked with queryDist.
+    */
+    std::vector<std::pair<float, int> >
+    search(const distribution<float> & query,
+           const std::function<float (int)> & queryDist,
+           int numNeighbors, double maxDistance) const
+    {
+        if (!pq.trained() || pqCodes.size() < rows.size() * pq.numSubspaces)
+            return indexSearch(queryDist, numNeighbors, maxDistance);
+
+        AdcTable table;
+        distance->adcTable(pq, query, table);
+
+        auto approxDist = [&] (int row) -> float
+            {
+                return distance->adcDist(row, table,
+                                         &pqCodes[row * pq.numSubspaces]);
+            };
+
+        auto candidates = indexSearch(approxDist,
+                                      numNeighbors * config.pqRerank,
+                                      INFINITY);
+
+        std::vector<std::pair<float, int> > result;
+        for (auto & c: candidates) {
+            float dist = queryDist(c.second);
+            if (dist <= maxDistance)
+                result.emplace_back(dist, c.second);
+        }
+
+        std::sort(result.begin(), result.end());
+        if (result.size() > numNeighbors)
+            result.resize(numNeighbors);
+        return result;
+    }
+
+    /** Return the closest numNeighbors rows within maxDistance of each of
+        the queries, by calculating the distance to every row with the
+        batched distance kernels.  This is exact, and for a batch of
+        queries is faster than walking the vantage point tree for each of
+        them, since each row is loaded once for a whole block of queries.
+    */
+    std::vector<std::vector<std::pair<float, int> > >
+    scanSearch(const std::vector<distribution<float> > & queries,
+               int numNeighbors, double maxDistance) const
     {
+        static constexpr size_t QUERY_BLOCK = 64;
+        static constexpr size_t ROW_BLOCK = 256;
+
+        size_t numDims = columnNames.size();
+        std::vector<std::vector<std::pair<float, int> > >
+            result(queries.size());
+
+        auto scanQueryBlock = [&] (size_t block)
+            {
+                size_t firstQuery = block * QUERY_BLOCK;
+                size_t numQueries
+                    = std::min(QUERY_BLOCK, queries.size() - firstQuery);
+
+                std::vector<const float *> queryCoords(numQueries);
+                for (size_t i = 0;  i < numQueries;  ++i)
+                    queryCoords[i] = queries[firstQuery + i].data();
+
+                std::vector<int> rowNums(ROW_BLOCK);
+                std::vector<const float *> rowCoords(ROW_BLOCK);
+                std::vector<distribution<float> > storage(ROW_BLOCK);
+                std::vector<float> dists(numQueries * ROW_BLOCK);
+
+                // Max heap of the best rows so far for each query
+                std::vector<std::vector<std::pair<float, int> > >
+                    best(numQueries);
+
+                for (size_t firstRow = 0;  firstRow < rows.size();
+                     firstRow += ROW_BLOCK) {
+                    size_t numRows = std::min(ROW_BLOCK,
+                                              rows.size() - firstRow);
+                    for (size_t j = 0;  j < numRows;  ++j) {
+                        rowNums[j] = firstRow + j;
+                        rowCoords[j]
+                            = getCoords(firstRow + j, storage[j]).data();
+                    }
+
+                    distance->dists(queryCoords.data(), numQueries,
+                                    rowNums.data(), rowCoords.data(),
+                                    numRows, numDims, dists.data());
+
+                    for (size_t i = 0;  i < numQueries;  ++i) {
+                        auto & heap = best[i];
+                        for (size_t j = 0;  j < numRows;  ++j) {
+                            std::pair<float, int> entry
+                                (dists[i * numRows + j], rowNums[j]);
+                            if (entry.first > maxDistance)
+                                continue;
+                            if (heap.size() < numNeighbors) {
+                                heap.push_back(entry);
+                                std::push_heap(heap.begin(), heap.end());
+                            }
+                            else if (!heap.empty() && entry < heap.front()) {
+                                std::pop_heap(heap.begin(), heap.end());
+                                heap.back() = entry;
+                                std::push_heap(heap.begin(), heap.end());
+                            }
+                        }
+                    }
+                }
+
+                for (size_t i = 0;  i < numQueries;  ++i) {
+                    std::sort_heap(best[i].begin(), best[i].end());
+                    result[firstQuery + i] = std::move(best[i]);
+                }
+            };
+
+        parallelMap(0, (queries.size() + QUERY_BLOCK - 1) / QUERY_BLOCK,
+                    scanQueryBlock);
+
+        return result;
+    }
+
+    std::vector<std::pair<float, int> >
+    indexSearch(const std::function<float (int)> & dist,
+                int numNeighbors, double maxDistance) const
+    {
+        if (hnsw) {
+            return hnsw->search(dist, numNeighbors, maxDistance,
+                                config.hnswEfSearch);
+        }
+        return vpTree->search(dist, numNeighbors, maxDistance);
     }
 
     // Unfortunately, both '0' and 'null' hash to the same thing.  To
@@ -158,10 +672,13 @@ struct EmbeddingDatasetRepr {
 
         if (row1 == row2)
             return 0.0f;
-        
+
+        // Called in the inner loop of index building, so avoid allocating
+        static thread_local distribution<float> storage1, storage2;
+
         float result = distance->dist(row1, row2,
-                                      rows[row1].coords,
-                                      rows[row2].coords);
+                                      getCoords(row1, storage1),
+                                      getCoords(row2, storage2));
         
         ExcAssert(isfinite(result));
         return result;
@@ -172,8 +689,10 @@ struct EmbeddingDatasetRepr {
         ExcAssertLess(row1, rows.size());
         ExcAssertEqual(row2.size(), columns.size());
         
+        static thread_local distribution<float> storage;
+
         float result = distance->dist(row1, -1,
-                                      rows[row1].coords,
+                                      getCoords(row1, storage),
                                       row2);
         ExcAssert(isfinite(result));
         return result;
@@ -200,14 +719,25 @@ struct EmbeddingDatasetRepr {
         return { earliest, latest };
     }
     
+    EmbeddingDatasetConfig config;
     std::vector<ColumnPath> columnNames;
     std::vector<std::vector<float> > columns;
     LightweightHash<ColumnHash, int> columnIndex;
 
     std::vector<Row> rows;
     LightweightHash<uint64_t, int> rowIndex;
+
+    /// Coordinates of each row for float16 and int8 storage, bytesPerRow()
+    /// per row.  For float32 storage, they are in the rows and columns.
+    std::vector<uint8_t> quantized;
+
+    /// Product quantizer and codes of each row (pq.numSubspaces per row) if
+    /// pqSubspaces is set.  Rows are encoded on commit.
+    ProductQuantizer pq;
+    std::vector<uint8_t> pqCodes;
     
     std::unique_ptr<MLDB::VantagePointTreeT<int> > vpTree;
+    std::unique_ptr<HnswIndexT<int> > hnsw;  ///< Only for the hnsw index
     std::unique_ptr<DistanceMetric> distance;
 
     void save(const std::string & filename)
@@ -237,22 +767,29 @@ EmbeddingDatasetRepr::
 serialize(MLDB::DB::Store_Writer & store) const
 {
     store << string("EMBEDDING_DATASET")
-          << MLDB::DB::compact_size_t(1);  // version
+          << MLDB::DB::compact_size_t(3);  // version
     store << columnNames << columns << rows;
-    vpTree->serialize(store);
+    store << MLDB::DB::compact_size_t(config.storage) << quantized;
+    store << MLDB::DB::compact_size_t(pq.trained());
+    if (pq.trained())
+        store << pq << pqCodes;
+    store << MLDB::DB::compact_size_t(config.index);
+    if (hnsw)
+        hnsw->serialize(store);
+    else vpTree->serialize(store);
 }
 
 struct EmbeddingDataset::Itl
     : public MatrixView, public ColumnIndex {
-    Itl(MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr),
+    Itl(const EmbeddingDatasetConfig & config)
+        : config(config), committed(lock, config), uncommitted(nullptr),
           logger(MLDB::getMldbLog<ProximateVoxelsFunction>())
     {
     }
 
     // TODO: make it loadable...
-    Itl(const std::string & address, MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr), address(address),
+    Itl(const std::string & address, const EmbeddingDatasetConfig & config)
+        : config(config), committed(lock, config), uncommitted(nullptr), address(address),
           logger(MLDB::getMldbLog<ProximateVoxelsFunction>())
     {
     }
@@ -262,7 +799,7 @@ struct EmbeddingDataset::Itl
         delete uncommitted.load();
     }
 
-    MetricSpace metric;
+    EmbeddingDatasetConfig config;
 
     GcLock lock;
     RcuProtected<EmbeddingDatasetRepr> committed;
@@ -385,12 +922,16 @@ struct EmbeddingDataset::Itl
         if (row.rowName != rowName)
             return MatrixNamedRow();
 
+        distribution<float> storage;
+        const distribution<float> & coords
+            = repr->getCoords(it->second, storage);
+
         MatrixNamedRow result;
         result.rowHash = result.rowName = rowName;
-        result.columns.reserve(row.coords.size());
+        result.columns.reserve(coords.size());
 
-        for (unsigned i = 0;  i < row.coords.size();  ++i) {
-            result.columns.emplace_back(repr->columnNames[i], row.coords[i],
+        for (unsigned i = 0;  i < coords.size();  ++i) {
+            result.columns.emplace_back(repr->columnNames[i], coords[i],
                                         row.timestamp);
         }
         return result;
@@ -408,13 +949,17 @@ struct EmbeddingDataset::Itl
         
         const EmbeddingDatasetRepr::Row & row = repr->rows[it->second];
 
+        distribution<float> storage;
+        const distribution<float> & coords
+            = repr->getCoords(it->second, storage);
+
         MatrixRow result;
         result.rowHash = rowHash;
         result.rowName = row.rowName;
-        result.columns.reserve(row.coords.size());
+        result.columns.reserve(coords.size());
 
-        for (unsigned i = 0;  i < row.coords.size();  ++i) {
-            result.columns.emplace_back(repr->columnNames[i], row.coords[i],
+        for (unsigned i = 0;  i < coords.size();  ++i) {
+            result.columns.emplace_back(repr->columnNames[i], coords[i],
                                         row.timestamp);
         }
         return result;
@@ -500,7 +1045,9 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw AnnotatedException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> storage;
+        const vector<float> & columnVals
+            = repr->columnValues(it->second, storage);
 
         toStoreResult.isNumeric_ = true;
         toStoreResult.atMostOne_ = true;
@@ -525,7 +1072,9 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw AnnotatedException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> storage;
+        const vector<float> & columnVals
+            = repr->columnValues(it->second, storage);
 
         MatrixColumn result;
 
@@ -538,6 +1087,38 @@ struct EmbeddingDataset::Itl
         return result;
     }
 
+    /** Return the value of the column for all rows, ignoring timestamps.
+        The values are stored by column, so only the rows that pass the
+        filter are touched.
+    */
+    virtual std::vector<std::tuple<RowPath, CellValue> >
+    getColumnValues(const ColumnPath & column,
+                    const std::function<bool (const CellValue &)> & filter) const override
+    {
+        auto repr = committed();
+        if (!repr->initialized())
+            throw AnnotatedException(400, "Can't get unknown column");
+
+        auto it = repr->columnIndex.find(column);
+        if (it == repr->columnIndex.end())
+            throw AnnotatedException(400, "Can't get name of unknown column");
+
+        vector<float> storage;
+        const vector<float> & columnVals
+            = repr->columnValues(it->second, storage);
+
+        std::vector<std::tuple<RowPath, CellValue> > result;
+        for (unsigned i = 0;  i < columnVals.size();  ++i) {
+            CellValue v(columnVals[i]);
+            if (filter && !filter(v))
+                continue;
+            result.emplace_back(repr->rows[i].rowName, std::move(v));
+        }
+
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
     virtual std::vector<CellValue>
     getColumnDense(const ColumnPath & column) const override
     {
@@ -549,7 +1130,9 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw AnnotatedException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> storage;
+        const vector<float> & columnVals
+            = repr->columnValues(it->second, storage);
 
         std::vector<CellValue> result(columnVals.begin(), columnVals.end());
 
@@ -568,7 +1151,9 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw AnnotatedException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> storage;
+        const vector<float> & columnVals
+            = repr->columnValues(it->second, storage);
         auto sortedVals = columnVals;
         std::sort(sortedVals.begin(), sortedVals.end());
         sortedVals.erase(std::unique(sortedVals.begin(), sortedVals.end()),
@@ -579,14 +1164,17 @@ struct EmbeddingDataset::Itl
         BucketDescriptions descriptions;
         descriptions.initialize(valueList, maxNumBuckets);
 
-        // Finally, perform the bucketed lookup
-        WritableBucketList buckets(columnVals.size(), descriptions.numBuckets());
-
-        for (auto& v : columnVals) {
-            uint32_t bucket = descriptions.getBucket(v);
-            buckets.write(bucket);
+        // Finally, perform the bucketed lookup, which is all numeric
+        std::vector<uint32_t> bucketNumbers(columnVals.size());
+        if (!columnVals.empty()) {
+            std::vector<double> values(columnVals.begin(), columnVals.end());
+            descriptions.numeric.getBuckets(values.data(), values.size(),
+                                            bucketNumbers.data());
         }
 
+        WritableBucketList buckets(columnVals.size(), descriptions.numBuckets());
+        buckets.writeParallel(bucketNumbers.data(), bucketNumbers.size());
+
         return std::make_tuple(std::move(buckets), std::move(descriptions));
     }
 
@@ -672,7 +1260,7 @@ struct EmbeddingDataset::Itl
         if (!uncommitted) {
             if (!repr->initialized()) {
                 // First commit; we just learnt the column names
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
@@ -721,19 +1309,12 @@ struct EmbeddingDataset::Itl
                 }
             }
 
-            size_t numRowsBefore = (*uncommitted).rows.size();
-        
             try {
                 // Update the row
-                (*uncommitted).rows.emplace_back(rowName, std::move(embedding),
-                                                 ts);
-                (*uncommitted).distance->addRow(numRowsBefore,
-                                                (*uncommitted).rows.back().coords);
+                (*uncommitted).addRow(rowName, std::move(embedding), ts);
             } catch (const std::exception & exc) {
                 // If there is an exception, keep the data structure consistent
                 (*uncommitted).rowIndex[rowHash] = -1;
-                if ((*uncommitted).rows.size() > numRowsBefore)
-                    (*uncommitted).rows.pop_back();
                 throw;
             }        
         }
@@ -791,7 +1372,7 @@ struct EmbeddingDataset::Itl
                 
                 //DEBUG_MSG(logger) << "columnNames = " << columnNames;
                 
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
@@ -850,19 +1431,12 @@ struct EmbeddingDataset::Itl
             }
         }
 
-        size_t numRowsBefore = (*uncommitted).rows.size();
-        
         try {
             // Update the row
-            (*uncommitted).rows.emplace_back(rowName, std::move(embedding),
-                                             latestDate);
-            (*uncommitted).distance->addRow(numRowsBefore,
-                                            (*uncommitted).rows.back().coords);
+            (*uncommitted).addRow(rowName, std::move(embedding), latestDate);
         } catch (const std::exception & exc) {
             // If there is an exception, keep the data structure consistent
             (*uncommitted).rowIndex[rowHash] = -1;
-            if ((*uncommitted).rows.size() > numRowsBefore)
-                (*uncommitted).rows.pop_back();
             throw;
         }        
     }
@@ -876,17 +1450,30 @@ struct EmbeddingDataset::Itl
         if (!uncommitted)
             return;
 
-        for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
-            (*uncommitted).columns[j].resize((*uncommitted).rows.size());
+        // Quantized values are only kept by row, to save memory
+        if ((*uncommitted).config.storage == EMBEDDING_STORAGE_FLOAT32) {
+            for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
+                (*uncommitted).columns[j].resize((*uncommitted).rows.size());
 
-        // Create the column index; this is a standard matrix inversion
-        auto indexRow = [&] (size_t i)
-            {
-                for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
-                    (*uncommitted).columns[j][i] = (*uncommitted).rows[i].coords[j];
-            };
+            // Create the column index; this is a standard matrix inversion
+            auto indexRow = [&] (size_t i)
+                {
+                    for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
+                        (*uncommitted).columns[j][i] = (*uncommitted).rows[i].coords[j];
+                };
 
-        parallelMap(0, (*uncommitted).rows.size(), indexRow);
+            parallelMap(0, (*uncommitted).rows.size(), indexRow);
+        }
+
+        (*uncommitted).encodePq();
+
+        // The HNSW index was built as the rows were recorded
+        if ((*uncommitted).hnsw) {
+            INFO_MSG(logger) << "hnsw index has " << (*uncommitted).hnsw->size()
+                             << " rows";
+            commitRepr();
+            return;
+        }
 
         // Create the vantage point tree
         INFO_MSG(logger) << "creating vantage point tree";
@@ -922,7 +1509,9 @@ struct EmbeddingDataset::Itl
                     ExcAssert(isfinite(result[n]));
                 };
 
-                if (items.size() < 10000 || depth > 2) {
+                // Subtrees are built in parallel on the same thread pool,
+                // so large subsets are worth splitting at any depth
+                if (items.size() < 10000) {
                     for (unsigned n = 0;  n < items.size();  ++n)
                         doItem(n);
                 }
@@ -935,7 +1524,13 @@ struct EmbeddingDataset::Itl
         (*uncommitted).vpTree.reset(MLDB::VantagePointTreeT<int>::createParallel(items, dist));
 
         INFO_MSG(logger) << "VP tree done in " << timer.elapsed();
-        
+
+        commitRepr();
+    }
+
+    // Must be called with the mutex held
+    void commitRepr()
+    {
         committed.replace(uncommitted);
         uncommitted = nullptr;
 
@@ -963,7 +1558,7 @@ struct EmbeddingDataset::Itl
 
         //Timer timer;
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        auto neighbors = repr->search(coord, dist, numNeighbors, maxDistance);
 
         //DEBUG_MSG(logger) << "neighbors took " << timer.elapsed();
 
@@ -979,6 +1574,66 @@ struct EmbeddingDataset::Itl
         return result;
     }
 
+    vector<vector<tuple<RowPath, RowHash, float> > >
+    getNeighborsBatch(const vector<distribution<float> > & coords,
+                      int numNeighbors,
+                      double maxDistance)
+    {
+        auto repr = committed();
+        if (!repr->initialized())
+            return vector<vector<tuple<RowPath, RowHash, float> > >
+                (coords.size());
+
+        for (auto & c: coords) {
+            if (c.size() != repr->columnNames.size())
+                throw AnnotatedException
+                    (400, "Wrong number of coordinates for the embedding "
+                     "dataset in neighbors query",
+                     "expected", repr->columnNames.size(),
+                     "got", c.size());
+            for (float v: c) {
+                if (!isfinite(v))
+                    throw AnnotatedException
+                        (400, "Neighbors query coordinates must be finite",
+                         "coords", c);
+            }
+        }
+
+        vector<vector<pair<float, int> > > neighbors;
+
+        if (repr->hnsw) {
+            // The graph only looks at a small fraction of the rows for each
+            // query, so answer them independently
+            neighbors.resize(coords.size());
+
+            auto searchQuery = [&] (size_t i)
+                {
+                    auto dist = [&] (int item) -> float
+                        {
+                            return repr->dist(item, coords[i]);
+                        };
+                    neighbors[i] = repr->search(coords[i], dist,
+                                                numNeighbors, maxDistance);
+                };
+
+            parallelMap(0, coords.size(), searchQuery);
+        }
+        else {
+            neighbors = repr->scanSearch(coords, numNeighbors, maxDistance);
+        }
+
+        vector<vector<tuple<RowPath, RowHash, float> > > result(coords.size());
+        for (size_t i = 0;  i < coords.size();  ++i) {
+            for (auto & n: neighbors[i]) {
+                result[i].emplace_back(repr->rows[n.second].rowName,
+                                       repr->rows[n.second].rowName,
+                                       n.first);
+            }
+        }
+
+        return result;
+    }
+
     vector<tuple<RowPath, RowHash, float> >
     getRowNeighbors(const RowPath & row, int numNeighbors, double maxDistance)
     {
@@ -1003,7 +1658,9 @@ struct EmbeddingDataset::Itl
                 return result;
             };
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        distribution<float> storage;
+        auto neighbors = repr->search(repr->getCoords(it->second, storage),
+                                      dist, numNeighbors, maxDistance);
 
         vector<tuple<RowPath, RowHash, float> > result;
         for (auto & n: neighbors) {
@@ -1038,7 +1695,7 @@ EmbeddingDataset(MldbEngine * owner,
 {
     this->datasetConfig = config.params.convert<EmbeddingDatasetConfig>();
 #if 1
-    itl.reset(new Itl(datasetConfig.metric));
+    itl.reset(new Itl(datasetConfig));
 #else // once persistence is done
 
     if (!config.address.empty()) {
@@ -1082,7 +1739,8 @@ void
 EmbeddingDataset::
 commit()
 {
-    return itl->commit();
+    itl->commit();
+    dataChanged();
 }
     
 std::pair<Date, Date>
@@ -1136,6 +1794,14 @@ getNeighbors(const distribution<float> & coord, int numNeighbors, double maxDist
     return itl->getNeighbors(coord, numNeighbors, maxDistance);
 }
     
+vector<vector<tuple<RowPath, RowHash, float> > >
+EmbeddingDataset::
+getNeighborsBatch(const vector<distribution<float> > & coords,
+                  int numNeighbors, double maxDistance) const
+{
+    return itl->getNeighborsBatch(coords, numNeighbors, maxDistance);
+}
+
 vector<tuple<RowPath, RowHash, float> >
 EmbeddingDataset::
 getRowNeighbors(const RowPath & row, int numNeighbors, double maxDistance) const
@@ -1225,6 +1891,12 @@ NearestNeighborsInputDescription()
              "Coordinates of the value whose neighbors are being sought, "
              "or alternatively the `rowName` of the value in the underlying "
              "dataset whose neighbors are being sought");
+    addField("queries", &NearestNeighborsInput::queries,
+             "Row of many values whose neighbors are being sought, each "
+             "given like `coords`, to be answered at once instead of "
+             "`coords`.  The `neighbors` and `distances` are then rows with "
+             "the same columns, each containing the result for that value.  "
+             "This is much faster than one call per value.");
 }
 
 DEFINE_STRUCTURE_DESCRIPTION(NearestNeighborsOutput);
@@ -1286,6 +1958,81 @@ applyT(const ApplierT & applier_, NearestNeighborsInput input) const
         maxDistance = input.maxDistance.toDouble();
     
     Date ts;
+
+    auto neighborsOutput = [&] (vector<tuple<RowPath, RowHash, float> > neighbors)
+        -> NearestNeighborsOutput
+        {
+            std::vector<CellValue> neighborsOut;
+            RowValue distances;
+
+            distances.reserve(neighbors.size());
+            neighborsOut.reserve(neighbors.size());
+            for(auto & neighbor : neighbors) {
+                distances.emplace_back(get<0>(neighbor), get<2>(neighbor), ts);
+                neighborsOut.emplace_back(std::move(std::get<0>(neighbor)));
+            }
+
+            return {ExpressionValue(std::move(neighborsOut), ts),
+                    ExpressionValue(std::move(distances))};
+        };
+
+    if (!input.queries.empty()) {
+        if (!inputRow.empty())
+            throw AnnotatedException
+                (400, "Only one of coords and queries can be passed to the "
+                 "embedding.neighbors function");
+
+        // Queries with coordinates are answered together; those with row
+        // names are looked up one by one
+        std::vector<PathElement> queryNames;
+        std::vector<vector<tuple<RowPath, RowHash, float> > > queryNeighbors;
+        std::vector<distribution<float> > coords;
+        std::vector<size_t> coordsQueries;
+
+        auto onQuery = [&] (const PathElement & name,
+                            const ExpressionValue & query)
+            {
+                queryNames.push_back(name);
+                queryNeighbors.emplace_back();
+                if (query.isAtom()) {
+                    queryNeighbors.back() = applier.embeddingDataset
+                        ->getRowNeighbors(RowPath(query.toUtf8String()),
+                                          numNeighbors, maxDistance);
+                }
+                else {
+                    coords.emplace_back(applier.getEmbeddingFromExpr(query)
+                                        .cast<float>());
+                    coordsQueries.push_back(queryNames.size() - 1);
+                }
+                return true;
+            };
+
+        if (!input.queries.isRow())
+            throw AnnotatedException
+                (400, "The queries passed to the embedding.neighbors "
+                 "function must be a row of row names or embeddings");
+        input.queries.forEachColumn(onQuery);
+
+        auto batchNeighbors = applier.embeddingDataset
+            ->getNeighborsBatch(coords, numNeighbors, maxDistance);
+        for (size_t i = 0;  i < coords.size();  ++i)
+            queryNeighbors[coordsQueries[i]] = std::move(batchNeighbors[i]);
+
+        StructValue neighborsOut, distancesOut;
+        neighborsOut.reserve(queryNames.size());
+        distancesOut.reserve(queryNames.size());
+        for (size_t i = 0;  i < queryNames.size();  ++i) {
+            auto output = neighborsOutput(std::move(queryNeighbors[i]));
+            neighborsOut.emplace_back(queryNames[i],
+                                      std::move(output.neighbors));
+            distancesOut.emplace_back(queryNames[i],
+                                      std::move(output.distances));
+        }
+
+        return {ExpressionValue(std::move(neighborsOut)),
+                ExpressionValue(std::move(distancesOut))};
+    }
+
     vector<tuple<RowPath, RowHash, float> > neighbors;
     if (inputRow.isAtom()) {
         neighbors = applier.embeddingDataset
@@ -1301,18 +2048,7 @@ applyT(const ApplierT & applier_, NearestNeighborsInput input) const
         throw MLDB::Exception("Input row must be either a row name or an embedding");
     }
 
-    std::vector<CellValue> neighborsOut;
-    RowValue distances;
-
-    distances.reserve(neighbors.size());
-    neighborsOut.reserve(neighbors.size());
-    for(auto & neighbor : neighbors) {
-        distances.emplace_back(get<0>(neighbor), get<2>(neighbor), ts);
-        neighborsOut.emplace_back(std::move(std::get<0>(neighbor)));
-    }
-
-    return {ExpressionValue(std::move(neighborsOut), ts),
-            ExpressionValue(std::move(distances))};
+    return neighborsOutput(std::move(neighbors));
 }
     
 std::unique_ptr<FunctionApplierT<NearestNeighborsInput, NearestNeighborsOutput> >
@@ -22,13 +22,37 @@ namespace MLDB {
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+enum EmbeddingIndex {
+    EMBEDDING_INDEX_VP_TREE,  ///< Exact vantage point tree, built on commit
+    EMBEDDING_INDEX_HNSW      ///< Approximate HNSW graph, built incrementally
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingIndex);
+
+enum EmbeddingStorage {
+    EMBEDDING_STORAGE_FLOAT32,  ///< Full precision
+    EMBEDDING_STORAGE_FLOAT16,  ///< Half precision floating point
+    EMBEDDING_STORAGE_INT8      ///< 8 bits per value, scaled per row
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingStorage);
+
 struct EmbeddingDatasetConfig {
     EmbeddingDatasetConfig()
-        : metric(METRIC_EUCLIDEAN)
+        : metric(METRIC_EUCLIDEAN), index(EMBEDDING_INDEX_VP_TREE),
+          hnswM(16), hnswEfConstruction(200), hnswEfSearch(64),
+          storage(EMBEDDING_STORAGE_FLOAT32), pqSubspaces(0), pqRerank(4)
     {
     }
 
     MetricSpace metric;
+    EmbeddingIndex index;
+    int hnswM;
+    int hnswEfConstruction;
+    int hnswEfSearch;
+    EmbeddingStorage storage;
+    int pqSubspaces;
+    int pqRerank;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
@@ -80,6 +104,14 @@ struct EmbeddingDataset: public Dataset {
     getNeighbors(const distribution<float> & coord, int numNeighbors,
                  double maxDistance) const;
     
+    /** Find the neighbors of each of a batch of points at once.  This is
+        much faster than calling getNeighbors() for each of them, but
+        the distances may differ from it by rounding.
+    */
+    std::vector<std::vector<std::tuple<RowPath, RowHash, float> > >
+    getNeighborsBatch(const std::vector<distribution<float> > & coords,
+                      int numNeighbors, double maxDistance) const;
+
     std::vector<std::tuple<RowPath, RowHash, float> >
     getRowNeighbors(const RowPath & row, int numNeighbors,
                     double maxDistance) const;
@@ -114,6 +146,7 @@ DECLARE_STRUCTURE_DESCRIPTION(NearestNeighborsFunctionConfig);
 struct NearestNeighborsInput {
     NearestNeighborsInput();
     ExpressionValue coords;
+    ExpressionValue queries;  // row of coords to answer at once, or null
     CellValue numNeighbors; // positive integer or null
     CellValue maxDistance;  // double or null
 };
@@ -7,10 +7,12 @@
 LIBMLDB_EMBEDDING_PLUGIN_SOURCES:= \
 	embedding_plugin.cc \
 	embedding.cc \
+	mapped_embedding_dataset.cc \
 	svd.cc \
 
 
 LIBMLDB_EMBEDDING_PLUGIN_LINK:= \
+	algebra \
 
 $(eval $(call library,mldb_embedding_plugin,$(LIBMLDB_EMBEDDING_PLUGIN_SOURCES),$(LIBMLDB_EMBEDDING_PLUGIN_LINK)))
 
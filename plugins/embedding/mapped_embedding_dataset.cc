@@ -0,0 +1,704 @@
+/** mapped_embedding_dataset.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Implementation of the read-only embedding dataset over a vector file.
+*/
+
+#include "mapped_embedding_dataset.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/parallel_merge_sort.h"
+#include "mldb/utils/lightweight_hash.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/enum_description.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/engine/dataset_utils.h"
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* MAPPED EMBEDDING DATASET CONFIG                                           */
+/*****************************************************************************/
+
+DEFINE_ENUM_DESCRIPTION(EmbeddingFileFormat);
+
+EmbeddingFileFormatDescription::
+EmbeddingFileFormatDescription()
+{
+    addValue("word2vec", EMBEDDING_FILE_WORD2VEC_BINARY,
+             "Binary format written by the word2vec tool (and by fastText "
+             "and gensim when saving in the word2vec binary format): a "
+             "header line with the number of words and of dimensions, then "
+             "each word followed by a space and its values as 32 bit "
+             "floats.  The values are used in place.");
+    addValue("text", EMBEDDING_FILE_TEXT,
+             "Text format, with one word per line followed by its values "
+             "separated by spaces, as used by GloVe and by the fastText "
+             "`.vec` files.  A first line with the number of words and of "
+             "dimensions is skipped if present.  The values are parsed "
+             "into memory.");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(MappedEmbeddingDatasetConfig);
+
+MappedEmbeddingDatasetConfigDescription::
+MappedEmbeddingDatasetConfigDescription()
+{
+    addField("dataFileUrl", &MappedEmbeddingDatasetConfig::dataFileUrl,
+             "URL of the vector file.  Uncompressed local files are memory "
+             "mapped rather than read, which makes loading fast and lets "
+             "all of the processes on a machine that use the same file "
+             "share a single copy of it in memory.");
+    addField("format", &MappedEmbeddingDatasetConfig::format,
+             "Format of the vector file.",
+             EMBEDDING_FILE_WORD2VEC_BINARY);
+}
+
+
+/*****************************************************************************/
+/* MAPPED EMBEDDING INTERNAL REPRESENTATION                                  */
+/*****************************************************************************/
+
+namespace {
+
+/** Return the contents of the file, and an object that keeps them alive.
+    Uncompressed local files are memory mapped; anything else is read into
+    memory.
+*/
+std::pair<std::shared_ptr<const void>, std::pair<const char *, size_t> >
+openVectorFile(const Url & url, bool & isMapped)
+{
+    auto stream = std::make_shared<filter_istream>
+        (url, std::map<std::string, std::string>{ { "mapped", "true" } });
+
+    auto mapped = stream->mapped();
+    isMapped = mapped.first;
+    if (isMapped)
+        return { stream, mapped };
+
+    std::ostringstream streamo;
+    streamo << stream->rdbuf();
+    auto data = std::make_shared<std::string>(streamo.str());
+    return { data, { data->data(), data->size() } };
+}
+
+} // file scope
+
+struct MappedEmbeddingDataset::Itl
+    : public MatrixView, public ColumnIndex {
+
+    Itl(const MappedEmbeddingDatasetConfig & config)
+        : format(config.format), isMapped(false), numDims(0)
+    {
+        timestamp = getUriObjectInfo(config.dataFileUrl.toDecodedString())
+            .lastModified;
+
+        std::tie(mapping, contents)
+            = openVectorFile(config.dataFileUrl, isMapped);
+
+        if (format == EMBEDDING_FILE_WORD2VEC_BINARY)
+            indexBinary();
+        else indexText();
+
+        for (unsigned i = 0;  i < numDims;  ++i) {
+            columnNames.emplace_back(PathElement(i));
+            columnIndex[columnNames.back()] = i;
+        }
+
+        indexWords();
+    }
+
+    EmbeddingFileFormat format;
+
+    /// Keeps the memory pointed to by contents alive
+    std::shared_ptr<const void> mapping;
+    std::pair<const char *, size_t> contents;
+    bool isMapped;   ///< Is contents a memory mapping of the file?
+
+    size_t numDims;
+    Date timestamp;
+
+    std::vector<ColumnPath> columnNames;
+    LightweightHash<ColumnHash, int> columnIndex;
+
+    /// Word of each row, as its offset and length in the file.  For the
+    /// binary format, the values of the row follow the word and a space.
+    std::vector<uint64_t> wordOffsets;
+    std::vector<uint32_t> wordLengths;
+
+    /// Values of each row for the text format, numDims per row
+    std::vector<float> parsedValues;
+
+    /// (row hash, row number) sorted by hash
+    std::vector<std::pair<uint64_t, uint32_t> > rowIndex;
+
+    const char * data() const { return contents.first; }
+    size_t size() const { return contents.second; }
+
+    size_t numRows() const { return wordOffsets.size(); }
+
+    void addWord(const char * word, size_t len)
+    {
+        if (len == 0)
+            throw AnnotatedException(400, "Empty word in vector file",
+                                     "offset", word - data());
+        if (wordOffsets.size() >= std::numeric_limits<uint32_t>::max())
+            throw AnnotatedException(400, "Too many words in vector file");
+        wordOffsets.push_back(word - data());
+        wordLengths.push_back(len);
+    }
+
+    /** Parse the header line of the number of words and dimensions, and
+        return a pointer to the line after it, or null if the line isn't
+        a header.
+    */
+    const char * parseHeader(size_t & numWords, size_t & numDims) const
+    {
+        const char * end = data() + size();
+        const char * eol = (const char *)memchr(data(), '\n', size());
+        if (!eol)
+            eol = end;
+
+        std::string header(data(), eol);
+        unsigned long long words, dims;
+        char trailing;
+        if (sscanf(header.c_str(), "%llu %llu %c",
+                   &words, &dims, &trailing) != 2)
+            return nullptr;
+
+        numWords = words;
+        numDims = dims;
+        return std::min(eol + 1, end);
+    }
+
+    /** Find each word of a word2vec binary file.  The words have a variable
+        length and the values that follow them can contain any byte, so
+        this is a sequential walk through the file; it only reads the words
+        and skips the values.
+    */
+    void indexBinary()
+    {
+        size_t numWords;
+        const char * p = parseHeader(numWords, numDims);
+        if (!p || numDims == 0) {
+            throw AnnotatedException
+                (400, "word2vec file doesn't start with a line containing "
+                 "the number of words and of dimensions");
+        }
+
+        const char * end = data() + size();
+        size_t valueBytes = numDims * sizeof(float);
+
+        wordOffsets.reserve(numWords);
+        wordLengths.reserve(numWords);
+
+        for (size_t i = 0;  i < numWords;  ++i) {
+            // The word2vec tool writes a newline after each vector
+            while (p < end && (*p == '\n' || *p == '\r'))
+                ++p;
+
+            const char * space = (const char *)memchr(p, ' ', end - p);
+            if (!space || end - (space + 1) < valueBytes) {
+                throw AnnotatedException
+                    (400, "word2vec file is truncated",
+                     "wordsExpected", numWords, "wordsFound", i);
+            }
+
+            addWord(p, space - p);
+            p = space + 1 + valueBytes;
+        }
+    }
+
+    /** Find the lines of a text file in parallel, then parse each of them
+        in parallel.
+    */
+    void indexText()
+    {
+        size_t numWords = 0;
+        const char * firstLine = parseHeader(numWords, numDims);
+        if (!firstLine)
+            firstLine = data();
+
+        const char * end = data() + size();
+
+        // Find the start of each line, one block of the file per task
+        static constexpr size_t BLOCK_SIZE = 16 * 1024 * 1024;
+        size_t firstOffset = firstLine - data();
+        size_t numBlocks = (size() - firstOffset + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        std::vector<std::vector<uint64_t> > blockLines(numBlocks);
+
+        auto findLines = [&] (size_t block)
+            {
+                const char * p = firstLine + block * BLOCK_SIZE;
+                const char * blockEnd = std::min(p + BLOCK_SIZE, end);
+                if (block == 0)
+                    blockLines[block].push_back(firstOffset);
+                while (p < blockEnd) {
+                    p = (const char *)memchr(p, '\n', blockEnd - p);
+                    if (!p)
+                        break;
+                    ++p;
+                    if (p < end)
+                        blockLines[block].push_back(p - data());
+                }
+            };
+
+        parallelMap(0, numBlocks, findLines);
+
+        std::vector<uint64_t> lineStarts;
+        for (auto & lines: blockLines) {
+            lineStarts.insert(lineStarts.end(), lines.begin(), lines.end());
+            std::vector<uint64_t>().swap(lines);
+        }
+
+        auto lineEnd = [&] (size_t line) -> const char *
+            {
+                const char * result = line + 1 < lineStarts.size()
+                    ? data() + lineStarts[line + 1] - 1 : end;
+                if (result > data() + lineStarts[line] && result[-1] == '\r')
+                    --result;
+                return result;
+            };
+
+        // Skip blank lines, which includes a trailing newline
+        std::vector<uint64_t> rowLines;
+        rowLines.reserve(lineStarts.size());
+        for (size_t i = 0;  i < lineStarts.size();  ++i) {
+            if (lineEnd(i) > data() + lineStarts[i])
+                rowLines.push_back(i);
+        }
+
+        if (rowLines.empty()) {
+            numDims = 0;
+            return;
+        }
+
+        // Without a header, the first line tells us the number of dimensions
+        if (firstLine == data()) {
+            const char * p = data() + lineStarts[rowLines[0]];
+            const char * e = lineEnd(rowLines[0]);
+            std::string line(p, e);
+            std::istringstream tokens(line);
+            std::string token;
+            numDims = 0;
+            while (tokens >> token)
+                ++numDims;
+            if (numDims < 2)
+                throw AnnotatedException(400, "Vector file has no values");
+            --numDims;
+        }
+
+        wordOffsets.resize(rowLines.size());
+        wordLengths.resize(rowLines.size());
+        parsedValues.resize(rowLines.size() * numDims);
+
+        auto parseLines = [&] (size_t r0, size_t r1)
+            {
+                std::string line;
+                for (size_t r = r0;  r < r1;  ++r) {
+                    size_t lineNum = rowLines[r];
+                    const char * p = data() + lineStarts[lineNum];
+                    const char * e = lineEnd(lineNum);
+                    const char * space = (const char *)memchr(p, ' ', e - p);
+                    if (!space || space == p) {
+                        throw AnnotatedException
+                            (400, "Vector file line has no word and values",
+                             "lineNumber", lineNum + 1);
+                    }
+
+                    wordOffsets[r] = p - data();
+                    wordLengths[r] = space - p;
+
+                    // Copied so that strtof() sees a terminated string
+                    line.assign(space, e);
+                    const char * v = line.c_str();
+                    float * values = &parsedValues[r * numDims];
+                    for (size_t i = 0;  i < numDims;  ++i) {
+                        char * next;
+                        values[i] = strtof(v, &next);
+                        if (next == v) {
+                            throw AnnotatedException
+                                (400, "Vector file line has too few values",
+                                 "lineNumber", lineNum + 1,
+                                 "valuesExpected", numDims);
+                        }
+                        v = next;
+                    }
+                    while (*v == ' ' || *v == '\t')
+                        ++v;
+                    if (*v) {
+                        throw AnnotatedException
+                            (400, "Vector file line has too many values",
+                             "lineNumber", lineNum + 1,
+                             "valuesExpected", numDims);
+                    }
+                }
+            };
+
+        parallelMapChunked(0, rowLines.size(), 4096, parseLines);
+    }
+
+    /** Build the index from row hash to row number.  The hashes are
+        calculated and sorted in parallel.
+    */
+    void indexWords()
+    {
+        rowIndex.resize(numRows());
+
+        auto hashRows = [&] (size_t r0, size_t r1)
+            {
+                for (size_t r = r0;  r < r1;  ++r)
+                    rowIndex[r] = { RowHash(getRowPath(r)).hash(), r };
+            };
+
+        parallelMapChunked(0, numRows(), 65536, hashRows);
+        parallelQuickSortRecursive(rowIndex);
+    }
+
+    RowPath getRowPath(size_t row) const
+    {
+        return PathElement(data() + wordOffsets[row], wordLengths[row]);
+    }
+
+    /** Copy the values of the row into values, which has numDims entries.
+        The values in a binary file aren't aligned, so they're copied
+        rather than used through a pointer.
+    */
+    void getValues(size_t row, float * values) const
+    {
+        if (format == EMBEDDING_FILE_TEXT) {
+            std::copy_n(&parsedValues[row * numDims], numDims, values);
+            return;
+        }
+
+        memcpy(values, data() + wordOffsets[row] + wordLengths[row] + 1,
+               numDims * sizeof(float));
+    }
+
+    float getValue(size_t row, size_t column) const
+    {
+        if (format == EMBEDDING_FILE_TEXT)
+            return parsedValues[row * numDims + column];
+
+        float result;
+        memcpy(&result, data() + wordOffsets[row] + wordLengths[row] + 1
+                        + column * sizeof(float),
+               sizeof(float));
+        return result;
+    }
+
+    /// Return the row number of the row with the given name, or -1
+    ssize_t findRow(const RowPath & rowName) const
+    {
+        uint64_t hash = RowHash(rowName).hash();
+        auto it = std::lower_bound(rowIndex.begin(), rowIndex.end(),
+                                   std::make_pair(hash, uint32_t(0)));
+        for (;  it != rowIndex.end() && it->first == hash;  ++it) {
+            if (getRowPath(it->second) == rowName)
+                return it->second;
+        }
+        return -1;
+    }
+
+    /// Return the row number of the first row with the given hash, or -1
+    ssize_t findRow(const RowHash & rowHash) const
+    {
+        auto it = std::lower_bound(rowIndex.begin(), rowIndex.end(),
+                                   std::make_pair(rowHash.hash(),
+                                                  uint32_t(0)));
+        if (it == rowIndex.end() || it->first != rowHash.hash())
+            return -1;
+        return it->second;
+    }
+
+    int getColumnNumber(const ColumnPath & column) const
+    {
+        auto it = columnIndex.find(column);
+        if (it == columnIndex.end())
+            throw AnnotatedException(400, "Unknown column in embedding file",
+                                     "columnName", column);
+        return it->second;
+    }
+
+    template<typename Row>
+    void fillRow(size_t row, Row & result) const
+    {
+        std::vector<float> values(numDims);
+        getValues(row, values.data());
+        result.columns.reserve(numDims);
+        for (size_t i = 0;  i < numDims;  ++i)
+            result.columns.emplace_back(columnNames[i], values[i], timestamp);
+    }
+
+    virtual std::vector<RowPath>
+    getRowPaths(ssize_t start = 0, ssize_t limit = -1) const override
+    {
+        std::vector<RowPath> result;
+        if (limit == -1)
+            limit = numRows();
+        for (size_t i = start;  i < numRows() && i < start + limit;  ++i)
+            result.emplace_back(getRowPath(i));
+        return result;
+    }
+
+    virtual std::vector<RowHash>
+    getRowHashes(ssize_t start = 0, ssize_t limit = -1) const override
+    {
+        std::vector<RowHash> result;
+        if (limit == -1)
+            limit = numRows();
+        for (size_t i = start;  i < numRows() && i < start + limit;  ++i)
+            result.emplace_back(getRowPath(i));
+        return result;
+    }
+
+    virtual size_t getRowCount() const override
+    {
+        return numRows();
+    }
+
+    virtual bool knownRow(const RowPath & rowName) const override
+    {
+        return findRow(rowName) != -1;
+    }
+
+    virtual bool knownRowHash(const RowHash & rowHash) const
+    {
+        return findRow(rowHash) != -1;
+    }
+
+    virtual MatrixNamedRow getRow(const RowPath & rowName) const override
+    {
+        MatrixNamedRow result;
+        ssize_t row = findRow(rowName);
+        if (row == -1)
+            return result;
+
+        result.rowHash = result.rowName = rowName;
+        fillRow(row, result);
+        return result;
+    }
+
+    virtual MatrixRow getRowByHash(const RowHash & rowHash) const
+    {
+        MatrixRow result;
+        ssize_t row = findRow(rowHash);
+        if (row == -1)
+            return result;
+
+        result.rowHash = rowHash;
+        result.rowName = getRowPath(row);
+        fillRow(row, result);
+        return result;
+    }
+
+    virtual RowPath getRowPath(const RowHash & rowHash) const override
+    {
+        ssize_t row = findRow(rowHash);
+        if (row == -1)
+            throw AnnotatedException(400, "unknown row");
+        return getRowPath(row);
+    }
+
+    virtual bool knownColumn(const ColumnPath & column) const override
+    {
+        return columnIndex.count(column);
+    }
+
+    virtual ColumnPath getColumnPath(ColumnHash column) const override
+    {
+        auto it = columnIndex.find(column);
+        if (it == columnIndex.end())
+            throw AnnotatedException(400, "Can't get name of unknown column");
+        return columnNames[it->second];
+    }
+
+    virtual std::vector<ColumnPath>
+    getColumnPaths(ssize_t offset, ssize_t limit) const override
+    {
+        if (offset == 0 && limit == -1)
+            return columnNames;
+        auto result = columnNames;
+        return applyOffsetLimit(offset, limit, result);
+    }
+
+    virtual size_t getColumnCount() const override
+    {
+        return numDims;
+    }
+
+    virtual MatrixColumn getColumn(const ColumnPath & column) const override
+    {
+        int col = getColumnNumber(column);
+
+        MatrixColumn result;
+        result.columnHash = result.columnName = column;
+        result.rows.reserve(numRows());
+        for (size_t i = 0;  i < numRows();  ++i) {
+            result.rows.emplace_back(getRowPath(i), getValue(i, col),
+                                     timestamp);
+        }
+        return result;
+    }
+
+    virtual std::vector<CellValue>
+    getColumnDense(const ColumnPath & column) const override
+    {
+        int col = getColumnNumber(column);
+
+        std::vector<CellValue> result;
+        result.reserve(numRows());
+        for (size_t i = 0;  i < numRows();  ++i)
+            result.emplace_back(getValue(i, col));
+        return result;
+    }
+
+    struct MappedEmbeddingRowStream : public RowStream {
+
+        MappedEmbeddingRowStream(const MappedEmbeddingDataset::Itl * source)
+            : index(0), source(source)
+        {
+        }
+
+        virtual std::shared_ptr<RowStream> clone() const
+        {
+            return std::make_shared<MappedEmbeddingRowStream>(source);
+        }
+
+        virtual void initAt(size_t start)
+        {
+            index = start;
+        }
+
+        virtual RowPath next()
+        {
+            return source->getRowPath(index++);
+        }
+
+        virtual const RowPath & rowName(RowPath & storage) const
+        {
+            return storage = source->getRowPath(index);
+        }
+
+        size_t index;
+        const MappedEmbeddingDataset::Itl * source;
+    };
+
+    std::shared_ptr<RowStream> getRowStream() const
+    {
+        return std::make_shared<MappedEmbeddingRowStream>(this);
+    }
+};
+
+
+/*****************************************************************************/
+/* MAPPED EMBEDDING DATASET                                                  */
+/*****************************************************************************/
+
+MappedEmbeddingDataset::
+MappedEmbeddingDataset(MldbEngine * owner,
+                       PolyConfig config,
+                       const ProgressFunc & onProgress)
+    : Dataset(owner)
+{
+    datasetConfig = config.params.convert<MappedEmbeddingDatasetConfig>();
+    itl.reset(new Itl(datasetConfig));
+}
+
+MappedEmbeddingDataset::
+~MappedEmbeddingDataset()
+{
+}
+
+Any
+MappedEmbeddingDataset::
+getStatus() const
+{
+    Json::Value status;
+    status["rowCount"] = (Json::UInt)itl->numRows();
+    status["columnCount"] = (Json::UInt)itl->numDims;
+    status["mapped"] = itl->isMapped;
+    return status;
+}
+
+std::pair<Date, Date>
+MappedEmbeddingDataset::
+getTimestampRange() const
+{
+    if (itl->numRows() == 0 || itl->numDims == 0)
+        return { Date::notADate(), Date::notADate() };
+    return { itl->timestamp, itl->timestamp };
+}
+
+std::shared_ptr<MatrixView>
+MappedEmbeddingDataset::
+getMatrixView() const
+{
+    return itl;
+}
+
+std::shared_ptr<ColumnIndex>
+MappedEmbeddingDataset::
+getColumnIndex() const
+{
+    return itl;
+}
+
+std::shared_ptr<RowStream>
+MappedEmbeddingDataset::
+getRowStream() const
+{
+    return itl->getRowStream();
+}
+
+KnownColumn
+MappedEmbeddingDataset::
+getKnownColumnInfo(const ColumnPath & columnName) const
+{
+    itl->getColumnNumber(columnName);
+    return KnownColumn(columnName, std::make_shared<Float32ValueInfo>(),
+                       COLUMN_IS_DENSE);
+}
+
+std::vector<KnownColumn>
+MappedEmbeddingDataset::
+getKnownColumnInfos(const std::vector<ColumnPath> & columnNames) const
+{
+    std::vector<KnownColumn> result;
+    result.reserve(columnNames.size());
+    for (auto & columnName: columnNames)
+        result.emplace_back(getKnownColumnInfo(columnName));
+    return result;
+}
+
+std::shared_ptr<RowValueInfo>
+MappedEmbeddingDataset::
+getRowInfo() const
+{
+    std::vector<KnownColumn> knownColumns;
+    auto valueInfo = std::make_shared<Float32ValueInfo>();
+    for (size_t i = 0;  i < itl->columnNames.size();  ++i) {
+        knownColumns.emplace_back(itl->columnNames[i], valueInfo,
+                                  COLUMN_IS_DENSE, i /* fixed index */);
+    }
+    return std::make_shared<RowValueInfo>(knownColumns);
+}
+
+static RegisterDatasetType<MappedEmbeddingDataset, MappedEmbeddingDatasetConfig>
+regMappedEmbedding(builtinPackage(),
+                   "embedding.mapped",
+                   "Read-only embedding used in place from a word2vec, "
+                   "fastText or GloVe vector file",
+                   "datasets/MappedEmbeddingDataset.md.html");
+
+} // namespace MLDB
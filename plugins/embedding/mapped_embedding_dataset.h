@@ -0,0 +1,82 @@
+/** mapped_embedding_dataset.h                                     -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Read-only embedding dataset that is used in place from a word2vec,
+    fastText or GloVe vector file.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/types/url.h"
+#include "mldb/types/value_description_fwd.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* MAPPED EMBEDDING DATASET CONFIG                                           */
+/*****************************************************************************/
+
+enum EmbeddingFileFormat {
+    EMBEDDING_FILE_WORD2VEC_BINARY,  ///< word2vec binary format
+    EMBEDDING_FILE_TEXT              ///< One word and its values per line
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingFileFormat);
+
+struct MappedEmbeddingDatasetConfig {
+    MappedEmbeddingDatasetConfig()
+        : format(EMBEDDING_FILE_WORD2VEC_BINARY)
+    {
+    }
+
+    Url dataFileUrl;
+    EmbeddingFileFormat format;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(MappedEmbeddingDatasetConfig);
+
+
+/*****************************************************************************/
+/* MAPPED EMBEDDING DATASET                                                  */
+/*****************************************************************************/
+
+/** Dataset with one row per word of a vector file, and one column per
+    dimension.  Uncompressed local files are memory mapped, so that the
+    vectors of a word2vec binary file are read straight from the page
+    cache, which is shared between all of the processes that map the
+    same file.  Only an index of the words is built in memory.
+*/
+
+struct MappedEmbeddingDataset: public Dataset {
+
+    MappedEmbeddingDataset(MldbEngine * owner,
+                           PolyConfig config,
+                           const ProgressFunc & onProgress);
+
+    virtual ~MappedEmbeddingDataset();
+
+    virtual Any getStatus() const;
+
+    virtual std::pair<Date, Date> getTimestampRange() const;
+
+    virtual std::shared_ptr<MatrixView> getMatrixView() const;
+    virtual std::shared_ptr<ColumnIndex> getColumnIndex() const;
+    virtual std::shared_ptr<RowStream> getRowStream() const;
+
+    virtual KnownColumn getKnownColumnInfo(const ColumnPath & columnName) const;
+
+    virtual std::vector<KnownColumn>
+    getKnownColumnInfos(const std::vector<ColumnPath> & columnNames) const;
+
+    virtual std::shared_ptr<RowValueInfo> getRowInfo() const;
+
+private:
+    MappedEmbeddingDatasetConfig datasetConfig;
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
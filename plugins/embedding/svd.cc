@@ -34,7 +34,11 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/utils/progress.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/plugins/jml/algebra/lapack.h"
 #include <sstream>
+#include <random>
+#include <mutex>
 
 using namespace std;
 
@@ -55,6 +59,25 @@ T jsonDecodeFile(const std::string & filename, T * = 0)
     return result;
 }
 
+DEFINE_ENUM_DESCRIPTION(SvdAlgorithm);
+
+SvdAlgorithmDescription::
+SvdAlgorithmDescription()
+{
+    addValue("lanczos", SVD_LANCZOS,
+             "Calculate the full correlation matrix between the dense basis "
+             "vectors, and use Lanczos iterations to find its singular "
+             "values.  This is exact, but the runtime goes up with the "
+             "square of the number of basis vectors.");
+    addValue("randomized", SVD_RANDOMIZED,
+             "Use a randomized range finder (random projection, power "
+             "iterations and QR decomposition) to find the top singular "
+             "values, streaming over the row data in blocks.  The "
+             "correlation matrix is never calculated, so the runtime is "
+             "linear in the number of basis vectors and in the number of "
+             "singular values.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(SvdConfig);
 
 SvdConfigDescription::
@@ -88,6 +111,21 @@ SvdConfigDescription()
              "The runtime goes up with the square of this parameter, "
              "in other words 10 times as many is 100 times as long to run.",
              2000);
+    addField("algorithm", &SvdConfig::algorithm,
+             "Algorithm used to calculate the singular values of the dense "
+             "basis.  The `randomized` algorithm makes it feasible to use "
+             "many more dense basis vectors, at the cost of a small loss "
+             "of accuracy in the smallest singular values.",
+             SVD_LANCZOS);
+    addField("oversampling", &SvdConfig::oversampling,
+             "Number of extra random directions sampled by the `randomized` "
+             "algorithm beyond `numSingularValues`.  More gives more "
+             "accurate singular values.", 10);
+    addField("powerIterations", &SvdConfig::powerIterations,
+             "Number of power iterations performed by the `randomized` "
+             "algorithm.  Each one is a pass over the data, and makes the "
+             "result more accurate when the singular values decay slowly.",
+             2);
     addField("outputColumn", &SvdConfig::outputColumn,
              "Base name of the column that will be written by the SVD.  "
              "It will be an embedding with numSingularValues elements.",
@@ -102,10 +140,24 @@ SvdConfigDescription()
              "also be provided.");
     addParent<ProcedureConfig>();
 
+    std::function<void (SvdConfig *, JsonParsingContext &)>
+        validateAlgorithm = [] (SvdConfig * config,
+                                JsonParsingContext & context)
+        {
+            if (config->oversampling < 0)
+                throw AnnotatedException
+                    (400, "The svd.train `oversampling` must not be negative");
+            if (config->powerIterations < 0)
+                throw AnnotatedException
+                    (400, "The svd.train `powerIterations` must not be "
+                     "negative");
+        };
+
     onPostValidate = chain(validateQuery(&SvdConfig::trainingData,
                                          NoGroupByHaving(),
                                          MustContainFrom()),
-                           validateFunction<SvdConfig>());
+                           chain(validateFunction<SvdConfig>(),
+                                 validateAlgorithm));
 }
 
 DEFINE_STRUCTURE_DESCRIPTION(SimpleIntersectionEntry);
@@ -387,11 +439,185 @@ SvdBasisDescription()
     addField("modelTs", &SvdBasis::modelTs, "Timestamp of latest information incorporated into model");
 }
 
+namespace {
+
+/** The correlation matrix between the first ndims columns of a column
+    index, as calculated by calculateCorrelations(), but without ever
+    materializing it.  Instead, it is multiplied by a dense matrix by
+    streaming over the rows in blocks, as C M = X^T (X M) / n (plus a
+    correction of the diagonal, which calculateCorrelations() sets to
+    one).  This takes time linear in the number of non-zero values and
+    memory linear in ndims.
+*/
+struct ImplicitCorrelations {
+    ImplicitCorrelations(const ColumnIndexEntries & columnIndex, int ndims)
+        : columnIndex(columnIndex), ndims(ndims), numRows(0),
+          discreteRows(ndims), diagonalCorrection(ndims)
+    {
+        if (ndims > 0)
+            numRows = columnIndex[0].numExamples;
+
+        auto initColumn = [&] (int i)
+            {
+                const ColumnIndexEntry & column = columnIndex[i];
+                if (column.columnType == DISCRETE_SPARSE) {
+                    auto & rows = discreteRows[i];
+                    column.discreteValues.forEach([&] (uint32_t row)
+                                                  { rows.push_back(row); });
+                    std::sort(rows.begin(), rows.end());
+                }
+                diagonalCorrection[i] = 1.0 - column.correlation(column);
+            };
+
+        parallelMap(0, ndims, initColumn);
+    }
+
+    /// Number of rows that are streamed together
+    static constexpr size_t ROWS_PER_BLOCK = 4096;
+
+    /** Call fn(row, value) for each non-zero value of column i with a row
+        in [begin, end). */
+    template<typename Fn>
+    void forEachInRange(int i, uint32_t begin, uint32_t end, Fn && fn) const
+    {
+        const ColumnIndexEntry & column = columnIndex[i];
+        switch (column.columnType) {
+        case CONTINUOUS_DENSE:
+            for (uint32_t row = begin;  row < end;  ++row)
+                fn(row, column.continuousValues[row]);
+            return;
+        case CONTINUOUS_SPARSE: {
+            auto & values = column.sparseValues;
+            auto it = std::lower_bound(values.begin(), values.end(), begin,
+                                       [] (const std::pair<int, float> & v,
+                                           uint32_t row)
+                                       { return v.first < row; });
+            for (;  it != values.end() && it->first < end;  ++it)
+                fn(it->first, it->second);
+            return;
+        }
+        case DISCRETE_SPARSE: {
+            auto & rows = discreteRows[i];
+            auto it = std::lower_bound(rows.begin(), rows.end(), begin);
+            for (;  it != rows.end() && *it < end;  ++it)
+                fn(*it, 1.0f);
+            return;
+        }
+        }
+        throw MLDB::Exception("Unknown ColumnType");
+    }
+
+    /** Return C M, where M is an ndims x l matrix stored by rows. */
+    std::vector<double> multiply(const std::vector<double> & m, int l) const
+    {
+        ExcAssertEqual(m.size(), (size_t)ndims * l);
+
+        std::vector<double> result(ndims * l);
+        std::mutex resultMutex;
+
+        // Each chunk of rows accumulates into its own copy of the result,
+        // so we want a few per CPU, not one per block.
+        size_t numBlocks = (numRows + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK;
+        size_t numChunks = std::min<size_t>(numBlocks, 4 * numCpus());
+        size_t blocksPerChunk
+            = numChunks ? (numBlocks + numChunks - 1) / numChunks : 0;
+
+        auto doChunk = [&] (size_t chunk)
+            {
+                std::vector<double> accum(ndims * l);
+                std::vector<double> projected(ROWS_PER_BLOCK * l);
+
+                size_t firstBlock = chunk * blocksPerChunk;
+                size_t lastBlock = std::min(numBlocks,
+                                            firstBlock + blocksPerChunk);
+
+                for (size_t block = firstBlock;  block < lastBlock;  ++block) {
+                    uint32_t begin = block * ROWS_PER_BLOCK;
+                    uint32_t end = std::min<size_t>(numRows,
+                                                    begin + ROWS_PER_BLOCK);
+
+                    // projected = X M for the rows of the block
+                    std::fill(projected.begin(), projected.end(), 0.0);
+                    for (int i = 0;  i < ndims;  ++i) {
+                        const double * mi = &m[i * l];
+                        forEachInRange(i, begin, end,
+                                       [&] (uint32_t row, float value)
+                            {
+                                double * p = &projected[(row - begin) * l];
+                                SIMD::vec_add(p, value, mi, p, l);
+                            });
+                    }
+
+                    // accum += X^T projected for the rows of the block
+                    for (int i = 0;  i < ndims;  ++i) {
+                        double * ai = &accum[i * l];
+                        forEachInRange(i, begin, end,
+                                       [&] (uint32_t row, float value)
+                            {
+                                const double * p
+                                    = &projected[(row - begin) * l];
+                                SIMD::vec_add(ai, value, p, ai, l);
+                            });
+                    }
+                }
+
+                std::unique_lock<std::mutex> guard(resultMutex);
+                SIMD::vec_add(result.data(), accum.data(), result.data(),
+                              result.size());
+            };
+
+        parallelMap(0, numChunks, doChunk);
+
+        for (int i = 0;  i < ndims;  ++i) {
+            double * ri = &result[i * l];
+            SIMD::vec_scale(ri, 1.0 / numRows, ri, l);
+            SIMD::vec_add(ri, diagonalCorrection[i], &m[i * l], ri, l);
+        }
+
+        return result;
+    }
+
+    const ColumnIndexEntries & columnIndex;
+    int ndims;
+    size_t numRows;
+
+    /// Sorted rows of the discrete columns, so we can seek to a block
+    std::vector<std::vector<uint32_t> > discreteRows;
+
+    /// Amount to add to the diagonal so that it's one
+    distribution<double> diagonalCorrection;
+};
+
+/** Replace the ndims x l matrix y (stored by rows) by an orthonormal basis
+    for the span of its columns.  We use the right singular vectors of its
+    transpose, which is how LAPACK (being column major) sees it anyway;
+    unlike a QR decomposition, this copes with y being rank deficient.
+*/
+void orthonormalize(std::vector<double> & y, int ndims, int l)
+{
+    std::vector<double> s(l), u(l * l), vt(ndims * l);
+    int res = ML::LAPack::gesdd("S", l, ndims, y.data(), l, s.data(),
+                                u.data(), l, vt.data(), l);
+    if (res != 0)
+        throw MLDB::Exception("gesdd returned error %d", res);
+    y = std::move(vt);
+}
+
+} // file scope
+
 struct SvdTrainer {
     static SvdBasis calcSvdBasis(const ColumnCorrelations & correlations,
                                  int numSingularValues,
                                  shared_ptr<spdlog::logger> logger);
 
+    static SvdBasis
+    calcRandomizedSvdBasis(const ColumnIndexEntries & columnIndex,
+                           int numBasisVectors,
+                           int numSingularValues,
+                           int oversampling,
+                           int powerIterations,
+                           shared_ptr<spdlog::logger> logger);
+
     static SvdBasis calcRightSingular(const ClassifiedColumns & columns,
                                       const ColumnIndexEntries & columnIndex,
                                       const SvdBasis & svd,
@@ -539,6 +765,114 @@ calcSvdBasis(const ColumnCorrelations & correlations,
     return result;
 }
 
+SvdBasis
+SvdTrainer::
+calcRandomizedSvdBasis(const ColumnIndexEntries & columnIndex,
+                       int numBasisVectors,
+                       int numSingularValues,
+                       int oversampling,
+                       int powerIterations,
+                       shared_ptr<spdlog::logger> logger)
+{
+    // This finds the same decomposition as calcSvdBasis() on the output of
+    // calculateCorrelations(), ie the eigenvectors v of the correlation
+    // matrix C with singular values sqrt(v' C v), but using the randomized
+    // range finder of Halko, Martinsson and Tropp: C is sampled in l random
+    // directions, which are refined by power iterations, and the small
+    // l x l matrix Q' C Q is then decomposed exactly.
+
+    int ndims = std::min<int>(numBasisVectors, columnIndex.size());
+    int l = std::min(ndims, numSingularValues + oversampling);
+
+    Timer timer;
+
+    SvdBasis result;
+    result.modelTs = columnIndex.modelTs;
+
+    if (l == 0)
+        return result;
+
+    ImplicitCorrelations correlations(columnIndex, ndims);
+
+    INFO_MSG(logger) << "randomized SVD of " << ndims << " basis vectors "
+                     << "over " << correlations.numRows << " rows with "
+                     << l << " samples";
+
+    std::vector<double> q(ndims * l);
+    std::mt19937 rng(1);
+    std::normal_distribution<double> normal;
+    for (auto & v: q)
+        v = normal(rng);
+
+    for (int i = 0;  i <= powerIterations;  ++i) {
+        q = correlations.multiply(q, l);
+        orthonormalize(q, ndims, l);
+        DEBUG_MSG(logger) << "power iteration " << i << " done at "
+                          << timer.elapsed();
+    }
+
+    // b = Q' C Q, which is symmetric and positive semi-definite, so its
+    // singular values are its eigenvalues and U = V.
+    std::vector<double> cq = correlations.multiply(q, l);
+    std::vector<double> b(l * l);
+    for (int i = 0;  i < ndims;  ++i) {
+        for (int j = 0;  j < l;  ++j) {
+            SIMD::vec_add(&b[j * l], q[i * l + j], &cq[i * l], &b[j * l], l);
+        }
+    }
+
+    for (int i = 0;  i < l;  ++i) {
+        for (int j = 0;  j < i;  ++j) {
+            b[i * l + j] = b[j * l + i] = 0.5 * (b[i * l + j] + b[j * l + i]);
+        }
+    }
+
+    distribution<double> eigenvalues(l);
+    std::vector<double> u(l * l), vt(l * l);
+    int res = ML::LAPack::gesdd("S", l, l, b.data(), l, eigenvalues.data(),
+                                u.data(), l, vt.data(), l);
+    if (res != 0)
+        throw MLDB::Exception("gesdd returned error %d", res);
+
+    INFO_MSG(logger) << "done randomized SVD " << timer.elapsed();
+
+    // Skip the ones that are numerically zero, like calcSvdBasis()
+    int realD = 0;
+    while (realD < std::min(l, numSingularValues)
+           && isfinite(eigenvalues[realD])
+           && eigenvalues[realD] > 0.0
+           && sqrt(eigenvalues[realD] / eigenvalues[0]) > 1e-9)
+        ++realD;
+
+    INFO_MSG(logger) << "got " << realD << " singular values";
+
+    result.singularValues.resize(realD);
+    for (int j = 0;  j < realD;  ++j)
+        result.singularValues[j] = sqrt(eigenvalues[j]);
+
+    INFO_MSG(logger) << "svalues = " << result.singularValues;
+
+    result.columns.resize(ndims);
+    std::copy(columnIndex.begin(), columnIndex.begin() + ndims,
+              result.columns.begin());
+
+    // The singular vectors are V = Q U.  Column j of U is at u[j * l].
+    for (int i = 0;  i < ndims;  ++i) {
+        distribution<float> & d = result.columns[i].singularVector;
+        d.resize(realD);
+        for (int j = 0;  j < realD;  ++j)
+            d[j] = SIMD::vec_dotprod_dp(&q[i * l], &u[j * l], l);
+
+        ColumnPath columnName = result.columns[i].columnName;
+        CellValue cellValue = result.columns[i].cellValue;
+
+        result.columnIndex[columnName].values[cellValue] = i;
+        result.columnIndex[columnName].columnName = columnName;
+    }
+
+    return result;
+}
+
 SvdBasis
 SvdTrainer::
 calcRightSingular(const ClassifiedColumns & columns,
@@ -746,10 +1080,21 @@ run(const ProcedureRunConfig & run,
 
     ColumnIndexEntries columnIndex = invertFeatures(columns, extractedFeatures, logger, convertProgressToJson);
 
-    ColumnCorrelations correlations = calculateCorrelations(columnIndex, numBasisVectors, logger);
-    SvdBasis svd = SvdTrainer::calcSvdBasis(correlations,
-                                            runProcConf.numSingularValues,
-                                            logger);
+    SvdBasis svd;
+    if (runProcConf.algorithm == SVD_RANDOMIZED) {
+        svd = SvdTrainer::calcRandomizedSvdBasis(columnIndex, numBasisVectors,
+                                                 runProcConf.numSingularValues,
+                                                 runProcConf.oversampling,
+                                                 runProcConf.powerIterations,
+                                                 logger);
+    }
+    else {
+        ColumnCorrelations correlations
+            = calculateCorrelations(columnIndex, numBasisVectors, logger);
+        svd = SvdTrainer::calcSvdBasis(correlations,
+                                       runProcConf.numSingularValues,
+                                       logger);
+    }
 
     auto outputSvdColumns = [](const SvdBasis & basis) {
         stringstream output;
@@ -24,13 +24,23 @@ namespace MLDB {
 struct SelectExpression;
 struct SqlExpression;
 
+enum SvdAlgorithm {
+    SVD_LANCZOS,     ///< Lanczos iterations over the full correlation matrix
+    SVD_RANDOMIZED   ///< Randomized range finder over the row data
+};
+
+DECLARE_ENUM_DESCRIPTION(SvdAlgorithm);
+
 struct SvdConfig : ProcedureConfig {
     static constexpr char const * name = "svd.train";
 
     SvdConfig()
         : outputColumn("embedding"),
           numSingularValues(100),
-          numDenseBasisVectors(1000)
+          numDenseBasisVectors(1000),
+          algorithm(SVD_LANCZOS),
+          oversampling(10),
+          powerIterations(2)
     {
     }
 
@@ -43,6 +53,9 @@ struct SvdConfig : ProcedureConfig {
     PathElement outputColumn;
     int numSingularValues;
     int numDenseBasisVectors;
+    SvdAlgorithm algorithm;
+    int oversampling;
+    int powerIterations;
     Utf8String functionName;
 };
 
@@ -189,7 +189,15 @@ run(const ProcedureRunConfig & run,
     PerThreadAccumulator<vector<pair<RowPath, vector<Cell>>>> accum;
 
     auto bucketizeStep = iterationStep->nextStep(1);
-    atomic<ssize_t> rowIndex(0);
+    ProgressCounter rowsDone;
+    ProgressReporter progressReporter
+        ([&] () { return rowsDone.total(); },
+         [&] (uint64_t numRows)
+         {
+             bucketizeStep->updateValue((float)numRows / rowCount);
+             return onProgress(jsonEncode(bucketizeProgress));
+         });
+
     for (const auto & mappedRange: runProcConf.percentileBuckets) {
         std::vector<Cell> rowValue;
         rowValue.emplace_back(ColumnPath("bucket"),
@@ -198,7 +206,7 @@ run(const ProcedureRunConfig & run,
 
 
         auto applyFct = [&] (int64_t index) {
-            ++ rowIndex;
+            rowsDone.add();
             auto & rows = accum.get();
             rows.reserve(1024);
             rows.emplace_back(orderedRowNames[index], rowValue);
@@ -207,16 +215,7 @@ run(const ProcedureRunConfig & run,
                 output->recordRows(rows);
                 rows.clear();
             }
-            if ((rowIndex.load() % 2048) == 0) {
-                float newVal = (float)(rowIndex.load()) / rowCount;
-                lock_guard<mutex> lock(progressMutex);
-                if (newVal > bucketizeStep->value) {
-                    bucketizeStep->value = newVal;
-                }
-                if (!onProgress(jsonEncode(bucketizeProgress)))
-                    return false;
-            }
-            return true;
+            return !progressReporter.cancelled();
         };
         auto range = mappedRange.second;
 
@@ -235,6 +234,11 @@ run(const ProcedureRunConfig & run,
         }
     }
 
+    if (!progressReporter.finish()) {
+        throw CancellationException(std::string(BucketizeProcedureConfig::name) +
+                                    " procedure was cancelled");
+    }
+
     // record remainder
     accum.forEach([&] (vector<pair<RowPath, vector<Cell>>> * rows)
     {
@@ -134,45 +134,84 @@ getStat(DISTTABLE_STATISTICS stat) const
 /* DIST TABLE                                                                */
 /*****************************************************************************/
 
+// The stats are written and used in place as raw memory
+static_assert(std::is_trivially_copyable<DistTableStats>::value
+              && sizeof(DistTableStats) == 8 * sizeof(double),
+              "DistTableStats must be a flat array of 64 bit values");
+
 DistTable::
-DistTable(const std::string & filename):
-    unknownStats(std::vector<DistTableStats>(outcome_names.size()))
+DistTable(const std::string & filename)
 {
-    filter_istream stream(filename);
-    MLDB::DB::Store_Reader store(stream);
-    reconstitute(store);
+    MLDB::DB::Store_Reader store;
+    auto mapping = openStringCountsTableFile(Url(filename), store);
+    reconstitute(store, std::move(mapping));
+}
+
+void
+DistTable::
+unmap()
+{
+    if (!mapping_ && !index.isMapped())
+        return;
+
+    // A single table is copied with its entries in the same order
+    if (index.isMapped())
+        index = StringCountsTable::merge({ &index }, 0 /* numCounts */);
+
+    if (mapping_) {
+        ownedStats_.assign(mappedStats_,
+                           mappedStats_
+                           + index.size() * outcome_names.size());
+        mappedStats_ = nullptr;
+        mapping_.reset();
+    }
 }
 
 void
 DistTable::
 increment(const Utf8String & featureValue, const vector<double> & targets)
 {
-    const auto & it = stats.find(featureValue);
-    vector<DistTableStats> & targetStats =
-        it == stats.end()
-        ? stats[featureValue]
-        : it->second;
-    // if it's the first time we see that `featureValue`, let's prepare the
-    // stats vector
-    if (it == stats.end()) {
-        targetStats.reserve(targets.size());
-        for (int i=0; i < targets.size(); ++i)
-            targetStats.emplace_back();
+    size_t numOutcomes = outcome_names.size();
+    if (targets.size() != numOutcomes) {
+        throw AnnotatedException(400, MLDB::format(
+                    "dist table for '%s' has %zd outcomes but was "
+                    "incremented with %zd",
+                    colName.toUtf8String().rawData(), numOutcomes,
+                    targets.size()));
     }
 
-    for (int i=0; i < targets.size(); ++i) {
+    unmap();
+
+    const char * key = featureValue.rawData();
+    size_t len = featureValue.rawLength();
+    uint64_t hash = StringCountsTable::hashKey(key, len);
+
+    // if it's the first time we see that `featureValue`, the insertion
+    // gives it a new entry, and we prepare its stats
+    ssize_t entry = index.find(key, len, hash);
+    if (entry == -1) {
+        index.insert(key, len, hash);
+        entry = index.size() - 1;
+        ownedStats_.resize(index.size() * numOutcomes);
+    }
+
+    DistTableStats * targetStats = ownedStats_.data() + entry * numOutcomes;
+    for (int i=0; i < numOutcomes; ++i) {
         targetStats[i].increment(targets[i]);
     }
 }
 
-const vector<DistTableStats> &
+const DistTableStats *
 DistTable::
 getStats(const Utf8String & featureValue) const
 {
-    const auto & it = stats.find(featureValue);
-    if (it == stats.end())
-        return unknownStats;
-    return it->second;
+    const char * key = featureValue.rawData();
+    size_t len = featureValue.rawLength();
+    ssize_t entry
+        = index.find(key, len, StringCountsTable::hashKey(key, len));
+    if (entry == -1)
+        return unknownStats.data();
+    return statsData() + entry * outcome_names.size();
 }
 
 void DistTable::
@@ -186,29 +225,79 @@ save(const std::string & filename) const
 void DistTable::
 serialize(MLDB::DB::Store_Writer & store) const
 {
-    int version = 1;
+    // Version 2 replaced the map of values to stats by the index and a
+    // flat array of stats, which can be used in place from a mapped file
+    int version = 2;
     store << string("MLDB Dist Table Binary")
-          << version << colName << outcome_names << stats << unknownStats;
+          << version << colName << outcome_names << unknownStats;
+    index.serialize(store);
+
+    static const char padding[8] = { 0 };
+    store.save_binary(padding, (8 - store.offset() % 8) % 8);
+    store.save_binary(statsData(), index.size() * outcome_names.size()
+                      * sizeof(DistTableStats));
 }
 
 void DistTable::
-reconstitute(MLDB::DB::Store_Reader & store)
+reconstitute(MLDB::DB::Store_Reader & store,
+             std::shared_ptr<const void> mapping)
 {
     int version;
-    int REQUIRED_V = 1;
+    int REQUIRED_V = 2;
     std::string name;
     store >> name >> version;
     if (name != "MLDB Dist Table Binary") {
         throw AnnotatedException(400, "File does not appear to be a dist "
                                   "table model");
     }
-    if(version!=REQUIRED_V) {
+    if(version != REQUIRED_V && version != 1) {
         throw AnnotatedException(400, MLDB::format(
                     "invalid DistTable version! exptected %d, got %d",
                     REQUIRED_V, version));
     }
 
-    store >> colName >> outcome_names >> stats >> unknownStats;
+    ownedStats_.clear();
+    mappedStats_ = nullptr;
+    mapping_.reset();
+
+    if (version == 1) {
+        std::unordered_map<Utf8String, std::vector<DistTableStats>> oldStats;
+        store >> colName >> outcome_names >> oldStats >> unknownStats;
+
+        index = StringCountsTable(0 /* numCounts */);
+        for (auto & entry: oldStats) {
+            ExcAssertEqual(entry.second.size(), outcome_names.size());
+            const Utf8String & key = entry.first;
+            index.insert(key.rawData(), key.rawLength(),
+                         StringCountsTable::hashKey(key.rawData(),
+                                                    key.rawLength()));
+            ownedStats_.insert(ownedStats_.end(),
+                               entry.second.begin(), entry.second.end());
+        }
+        return;
+    }
+
+    store >> colName >> outcome_names >> unknownStats;
+    index.reconstitute(store, mapping);
+    if (index.numCounts() != 0
+        || unknownStats.size() != outcome_names.size())
+        throw AnnotatedException(400, "Dist table file is corrupt");
+
+    store.skip((8 - store.offset() % 8) % 8);
+
+    size_t numStats = index.size() * outcome_names.size();
+    size_t statsBytes = numStats * sizeof(DistTableStats);
+
+    if (mapping && store.must_have(statsBytes) >= statsBytes
+        && (uintptr_t)store.pos() % alignof(DistTableStats) == 0) {
+        mappedStats_ = (const DistTableStats *)store.pos();
+        mapping_ = std::move(mapping);
+        store.skip(statsBytes);
+    }
+    else {
+        ownedStats_.resize(numStats);
+        store.load_binary(ownedStats_.data(), statsBytes);
+    }
 }
 
 
@@ -608,9 +697,10 @@ DistTableFunction(MldbEngine * owner,
     int REQUIRED_VERSION = 2;
     int i_mode;
 
-    // Load saved stats tables
-    filter_istream stream(functionConfig.modelFileUrl);
-    MLDB::DB::Store_Reader store(stream);
+    // Load saved stats tables.  Uncompressed local files are memory mapped
+    // and the tables used in place, so that loading is immediate.
+    MLDB::DB::Store_Reader store;
+    mapping = openStringCountsTableFile(functionConfig.modelFileUrl, store);
     store >> version;
     if(version != REQUIRED_VERSION)
         throw MLDB::Exception("Wrong DistTable map version");
@@ -621,7 +711,12 @@ DistTableFunction(MldbEngine * owner,
     if(mode != DT_MODE_BAG_OF_WORDS && mode != DT_MODE_FIXED_COLUMNS)
         throw MLDB::Exception("Unsupported DistTable mode");
 
-    store >> distTablesMap;
+    MLDB::DB::compact_size_t numTables(store);
+    for (size_t i = 0;  i < numTables;  ++i) {
+        ColumnPath colName;
+        store >> colName;
+        distTablesMap[colName].reconstitute(store, mapping);
+    }
 
     // build a cache of the names for quick access
     for(int i=0; i<DT_NUM_STATISTICS; i++)
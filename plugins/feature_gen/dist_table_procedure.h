@@ -17,6 +17,7 @@
 #include "mldb/types/optional.h"
 #include "mldb/types/string.h"
 #include "mldb/rest/rest_request_router.h"
+#include "mldb/utils/string_counts_table.h"
 #include <shared_mutex>
 #include <unordered_map>
 
@@ -95,11 +96,20 @@ struct DistTableStats {
 };
 
 
+/** Distribution table for one feature column: the stats of each outcome
+    for each value of the feature.  The values are indexed by a
+    StringCountsTable (with no counts), and the stats are kept in a flat
+    array indexed by its entry numbers, so that the serialized form can be
+    used in place from a memory mapped file.  A table that was loaded in
+    place is copied into memory the first time that it's incremented.
+*/
+
 struct DistTable {
 
     DistTable(const ColumnPath & colName=ColumnPath("ND"),
             const std::vector<Utf8String> & outcome_names = {}):
         colName(colName), outcome_names(outcome_names),
+        index(0 /* numCounts */),
         unknownStats(std::vector<DistTableStats>(outcome_names.size()))
     {
     }
@@ -110,25 +120,47 @@ struct DistTable {
     void increment(const Utf8String & featureValue,
                    const std::vector<double> & targets);
 
-    // returns the stats for a given featureValue
-    // and outcome
-    const std::vector<DistTableStats> & getStats(
-            const Utf8String & featureValue) const;
+    // returns the stats for each outcome of a given featureValue, which
+    // are valid until the next call to increment()
+    const DistTableStats * getStats(const Utf8String & featureValue) const;
+
+    /// Number of distinct feature values in the table
+    size_t size() const { return index.size(); }
 
     void save(const std::string & filename) const;
     void serialize(MLDB::DB::Store_Writer & store) const;
-    void reconstitute(MLDB::DB::Store_Reader & store);
+
+    /** Reconstitute from the store.  See StringCountsTable::reconstitute()
+        for the meaning of mapping.
+    */
+    void reconstitute(MLDB::DB::Store_Reader & store,
+                      std::shared_ptr<const void> mapping = nullptr);
 
     ColumnPath colName;
 
     std::vector<Utf8String> outcome_names;
 
     // key: name of one of the values for our column
-    // value: aggregated stats for each outcome.
-    std::unordered_map<Utf8String, std::vector<DistTableStats>> stats;
+    // value: entry number of its stats
+    StringCountsTable index;
 
     // this is the same as getStats(unseenBeforeFeatureValue), but faster
     std::vector<DistTableStats> unknownStats;
+
+private:
+    // stats for each outcome of each entry in the index, either owned or
+    // used in place from memory kept alive by mapping_
+    std::vector<DistTableStats> ownedStats_;
+    const DistTableStats * mappedStats_ = nullptr;
+    std::shared_ptr<const void> mapping_;
+
+    const DistTableStats * statsData() const
+    {
+        return mapping_ ? mappedStats_ : ownedStats_.data();
+    }
+
+    // Copy a table used in place into memory so that it can be modified
+    void unmap();
 };
 
 
@@ -250,6 +282,9 @@ struct DistTableFunction: public Function {
     std::vector<DISTTABLE_STATISTICS> activeStats;
     mutable DistTablesMap distTablesMap;
 
+    /// Keeps alive the model file that the tables are used in place from
+    std::shared_ptr<const void> mapping;
+
     RestRequestRouter router;
 };
 
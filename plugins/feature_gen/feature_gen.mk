@@ -13,6 +13,7 @@ LIBMLDB_FEATURE_GEN_PLUGIN_SOURCES:= \
 
 
 LIBMLDB_FEATURE_GEN_PLUGIN_LINK:= \
+	string_counts_table \
 
 $(eval $(call library,mldb_feature_gen_plugin,$(LIBMLDB_FEATURE_GEN_PLUGIN_SOURCES),$(LIBMLDB_FEATURE_GEN_PLUGIN_LINK)))
 
@@ -6,15 +6,15 @@
 #include "feature_generators.h"
 #include "mldb/core/mldb_engine.h"
 #include "mldb/sql/sql_expression.h"
-#include "mldb/utils/distribution.h"
 #include "mldb/base/scope.h"
 #include "mldb/base/parallel.h"
 #include "mldb/types/basic_value_descriptions.h"
-#include "mldb/utils/lightweight_hash.h"
 #include "mldb/types/any_impl.h"
 #include "utils/json_utils.h"
 #include "mldb/ext/highwayhash.h"
 #include "mldb/utils/log.h"
+#include "mldb/types/annotated_exception.h"
+#include <algorithm>
 
 using namespace std;
 
@@ -45,8 +45,8 @@ HashedColumnFeatureGeneratorConfigDescription::
 HashedColumnFeatureGeneratorConfigDescription()
 {
     addField("numBits", &HashedColumnFeatureGeneratorConfig::numBits,
-             "Number of bits to use for the hash. The number of resulting "
-                "buckets will be $$2^{\\text{numBits}}$$.", 8);
+             "Number of bits to use for the hash, between 1 and 30. The "
+             "number of resulting buckets will be $$2^{\\text{numBits}}$$.", 8);
     addField("mode", &HashedColumnFeatureGeneratorConfig::mode,
             "Hashing mode to use. Controls what gets hashed.",
             COLUMNS);
@@ -80,6 +80,13 @@ HashedColumnFeatureGenerator(MldbEngine * owner,
 {
     functionConfig = config.params.convert<HashedColumnFeatureGeneratorConfig>();
 
+    if (functionConfig.numBits < 1 || functionConfig.numBits > 30) {
+        throw AnnotatedException(400, "feature_hasher numBits must be "
+                                 "between 1 and 30",
+                                 "numBits", functionConfig.numBits);
+    }
+
+    // The output column names are made once here and shared by all calls
     for(int i=0; i<numBuckets(); i++) {
         outputColumns.emplace_back(ColumnPath(MLDB::format("hashColumn%d", i)),
                                    std::make_shared<Float32ValueInfo>(),
@@ -92,13 +99,42 @@ HashedColumnFeatureGenerator::
 {
 }
 
-FeatureGeneratorOutput
-HashedColumnFeatureGenerator::
-call(FeatureGeneratorInput input) const
+namespace {
+
+/** Add each of the hashes to the bucket counts.  Each numBits-bit chunk of
+    a hash, from the least significant, selects a bucket which is
+    alternately incremented and decremented.
+
+    The loops go over the chunks on the outside, so that the bucket numbers
+    of a block of hashes are calculated with the same shift, which
+    vectorizes; only the scattered increments are left scalar.
+*/
+void accumulateHashes(const uint64_t * hashes, size_t n, int numBits,
+                      int32_t * counts)
 {
-    distribution<float> result(numBuckets());
+    static constexpr size_t BLOCK_SIZE = 256;
+    uint32_t buckets[BLOCK_SIZE];
+    const uint64_t mask = (1ULL << numBits) - 1;
+
+    for (size_t i0 = 0;  i0 < n;  i0 += BLOCK_SIZE) {
+        size_t blockSize = std::min(BLOCK_SIZE, n - i0);
+        int32_t sign = 1;
+        for (int bit = 0;  bit <= 63;  bit += numBits, sign = -sign) {
+            for (size_t i = 0;  i < blockSize;  ++i)
+                buckets[i] = (hashes[i0 + i] >> bit) & mask;
+            for (size_t i = 0;  i < blockSize;  ++i)
+                counts[buckets[i]] += sign;
+        }
+    }
+}
 
-    LightweightHash_Set<uint64_t> doneHashes;
+} // file scope
+
+ExpressionValue
+HashedColumnFeatureGenerator::
+hashRow(const ExpressionValue & columns, Scratch & scratch) const
+{
+    scratch.hashes.clear();
 
     Date ts = Date::negativeInfinity();
 
@@ -107,47 +143,86 @@ call(FeatureGeneratorInput input) const
     {
         ts.setMax(val.getEffectiveTimestamp());
 
-        uint64_t hash;
         if(functionConfig.mode == COLUMNS) {
-            hash = columnName.hash();
+            scratch.hashes.push_back(columnName.hash());
         }
         else if(functionConfig.mode == COLUMNS_AND_VALUES) {
-            Utf8String str(columnName.toUtf8String() + "::" + val.toUtf8String());
+            // Build column + "::" + value in place, without allocating
+            std::string & key = scratch.key;
+            key.clear();
+            if (!columnName.empty()) {
+                auto name = columnName.getStringView();
+                key.append(name.first, name.second);
+            }
+            key += "::";
+            if (val.isAtom() && val.getAtom().isString()) {
+                const CellValue & cell = val.getAtom();
+                key.append(cell.stringChars(), cell.toStringLength());
+            }
+            else {
+                Utf8String str = val.toUtf8String();
+                key.append(str.rawData(), str.rawLength());
+            }
+
             // Keep sip hash so that old classifiers still work
-            hash = sipHash(defaultSeedStable.u64, str.rawData(), str.rawLength());
+            scratch.hashes.push_back
+                (sipHash(defaultSeedStable.u64, key.data(), key.size()));
         }
         else {
             throw MLDB::Exception("Unsupported hashing mode");
         }
 
-        if (!doneHashes.insert(hash).second)
-            return true;
-
-        TRACE_MSG(logger) << "got " << hash;
-
-        int bit = 0;
-        for (int i = 0;  bit <= 63;  ++i, bit += functionConfig.numBits) {
-            int bucket = (hash >> bit) & ((1ULL << functionConfig.numBits) - 1);
-            ExcAssert(bucket >= 0 && bucket <= numBuckets());
-            int val = (i % 2 ? -1 : 1);
-            TRACE_MSG(logger) << "bit = " << bit << " bucket = " << bucket
-                              << " val = " << val;
-            result[bucket] += val;
-        }
-
         return true;
     };
 
-    input.columns.forEachColumn(onColumn);
+    columns.forEachColumn(onColumn);
+
+    // Each distinct hash is only counted once
+    std::sort(scratch.hashes.begin(), scratch.hashes.end());
+    scratch.hashes.erase(std::unique(scratch.hashes.begin(),
+                                     scratch.hashes.end()),
+                         scratch.hashes.end());
+
+    scratch.counts.assign(numBuckets(), 0);
+    accumulateHashes(scratch.hashes.data(), scratch.hashes.size(),
+                     functionConfig.numBits, scratch.counts.data());
 
-    ExpressionValue foResult;
     RowValue rowVal;
-    for(int i=0; i<result.size(); i++) {
-        rowVal.push_back(make_tuple(ColumnPath(MLDB::format("hashColumn%d", i)),
-                                    CellValue(result[i]), ts));
+    rowVal.reserve(numBuckets());
+    for(int i=0; i<numBuckets(); i++) {
+        rowVal.emplace_back(outputColumns[i].columnName,
+                            CellValue(float(scratch.counts[i])), ts);
+    }
+
+    return ExpressionValue(std::move(rowVal));
+}
+
+FeatureGeneratorOutput
+HashedColumnFeatureGenerator::
+call(FeatureGeneratorInput input) const
+{
+    Scratch scratch;
+    return { hashRow(input.columns, scratch) };
+}
+
+std::vector<ExpressionValue>
+HashedColumnFeatureGenerator::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    Scratch scratch;
+    std::vector<ExpressionValue> result;
+    result.reserve(inputs.size());
+
+    for (auto & input: inputs) {
+        StructValue output;
+        output.emplace_back(PathElement("hash"),
+                            hashRow(input.getColumn(PathElement("columns")),
+                                    scratch));
+        result.emplace_back(std::move(output));
     }
 
-    return {ExpressionValue(rowVal)};
+    return result;
 }
 
 namespace {
@@ -58,6 +58,22 @@ struct HashedColumnFeatureGenerator: public ValueFunctionT<FeatureGeneratorInput
 
     virtual FeatureGeneratorOutput call(FeatureGeneratorInput input) const override;
 
+    /** Hash a batch of rows, sharing the working memory between them. */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const override;
+
+    /// Working memory for hashing a row, reused over the rows of a batch
+    struct Scratch {
+        std::vector<uint64_t> hashes;
+        std::vector<int32_t> counts;
+        std::string key;
+    };
+
+    /// Hash the columns of a row, returning the row of bucket counts
+    ExpressionValue hashRow(const ExpressionValue & columns,
+                            Scratch & scratch) const;
+
     std::vector<KnownColumn> outputColumns;
 
     HashedColumnFeatureGeneratorConfig functionConfig;
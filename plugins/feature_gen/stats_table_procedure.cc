@@ -28,6 +28,8 @@
 #include "mldb/base/parallel.h"
 #include "mldb/types/optional_description.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/per_thread_accumulator.h"
+#include <unordered_map>
 
 
 using namespace std;
@@ -69,44 +71,74 @@ operator >> (MLDB::DB::Store_Reader & store, Path & coords)
 /* STATS TABLE                                                               */
 /*****************************************************************************/
 
+StatsTablesMap
+loadStatsTables(const Url & url)
+{
+    MLDB::DB::Store_Reader store;
+    auto mapping = openStringCountsTableFile(url, store);
+
+    StatsTablesMap result;
+    MLDB::DB::compact_size_t numTables(store);
+    for (size_t i = 0;  i < numTables;  ++i) {
+        ColumnPath colName;
+        store >> colName;
+        result[colName].reconstitute(store, mapping);
+    }
+
+    return result;
+}
+
+StatsTable
+loadStatsTable(const Url & url)
+{
+    MLDB::DB::Store_Reader store;
+    auto mapping = openStringCountsTableFile(url, store);
+
+    StatsTable result;
+    result.reconstitute(store, std::move(mapping));
+    return result;
+}
+
 StatsTable::
 StatsTable(const std::string & filename)
 {
-    filter_istream stream(filename);
-    MLDB::DB::Store_Reader store(stream);
-    reconstitute(store);
+    *this = loadStatsTable(Url(filename));
+}
+
+StatsTable::BucketCounts
+StatsTable::
+incrementKey(StringCountsTable & counts, const char * key, size_t len,
+             const vector<uint> & outcomes)
+{
+    ExcAssertEqual(outcomes.size() + 1, counts.numCounts());
+    int64_t * c = counts.insert(key, len, StringCountsTable::hashKey(key, len));
+    c[0] += 1;
+    for (size_t i = 0;  i < outcomes.size();  ++i)
+        c[1 + i] += outcomes[i];
+    return { c };
 }
 
-const StatsTable::BucketCounts &
+StatsTable::BucketCounts
 StatsTable::
 increment(const CellValue & val, const vector<uint> & outcomes) {
     Utf8String key = val.toUtf8String();
-    auto it = counts.find(key);
-    if(it == counts.end()) {
-        auto rtn = counts.emplace(
-            key, make_pair(1, vector<int64_t>(outcomes.begin(),
-                                              outcomes.end())));
-        // return inserted value
-        return (*(rtn.first)).second;
-    }
-
-    it->second.first ++;
-    for(int i=0; i<outcomes.size(); i++)
-        it->second.second[i] += outcomes[i];
-
-    return it->second;
+    return incrementKey(counts, key.rawData(), key.rawLength(), outcomes);
 }
 
-const StatsTable::BucketCounts &
+StatsTable::BucketCounts
 StatsTable::
 getCounts(const CellValue & val) const
 {
     Utf8String key = val.toUtf8String();
-    auto it = counts.find(key);
-    if(it == counts.end()) {
-        return zeroCounts;
-    }
-    return it->second;
+    return { counts.get(key.rawData(), key.rawLength()) };
+}
+
+Utf8String
+StatsTable::
+key(size_t entry) const
+{
+    return Utf8String(std::string(counts.keyData(entry),
+                                  counts.keyLength(entry)));
 }
 
 void StatsTable::
@@ -120,29 +152,61 @@ save(const std::string & filename) const
 void StatsTable::
 serialize(MLDB::DB::Store_Writer & store) const
 {
-    int version = 2;
+    // Version 3 replaced the map of keys to counts by the flat arrays of
+    // StringCountsTable, which can be used in place from a mapped file
+    int version = 3;
     store << string("MLDB Stats Table Binary")
-          << version << colName << outcome_names << counts << zeroCounts;
+          << version << colName << outcome_names;
+    counts.serialize(store);
 }
 
 void StatsTable::
-reconstitute(MLDB::DB::Store_Reader & store)
+reconstitute(MLDB::DB::Store_Reader & store,
+             std::shared_ptr<const void> mapping)
 {
     int version;
-    int REQUIRED_V = 2;
+    int REQUIRED_V = 3;
     std::string name;
     store >> name >> version;
     if (name != "MLDB Stats Table Binary") {
         throw AnnotatedException(400, "File does not appear to be a stats "
                                   "table model");
     }
-    if(version!=REQUIRED_V) {
+    if(version != REQUIRED_V && version != 2) {
         throw AnnotatedException(400, MLDB::format(
                     "invalid StatsTable version! exptected %d, got %d",
                     REQUIRED_V, version));
     }
 
-    store >> colName >> outcome_names >> counts >> zeroCounts;
+    store >> colName >> outcome_names;
+
+    if (version == 2) {
+        std::unordered_map<Utf8String, std::pair<int64_t, vector<int64_t>>>
+            oldCounts;
+        std::pair<int64_t, vector<int64_t>> zeroCounts;
+        store >> oldCounts >> zeroCounts;
+
+        counts = StringCountsTable(1 + outcome_names.size());
+        vector<int64_t> c;
+        for (auto & entry: oldCounts) {
+            c.clear();
+            c.push_back(entry.second.first);
+            c.insert(c.end(),
+                     entry.second.second.begin(), entry.second.second.end());
+            ExcAssertEqual(c.size(), outcome_names.size() + 1);
+
+            const Utf8String & key = entry.first;
+            counts.add(key.rawData(), key.rawLength(),
+                       StringCountsTable::hashKey(key.rawData(),
+                                                  key.rawLength()),
+                       c.data());
+        }
+    }
+    else {
+        counts.reconstitute(store, std::move(mapping));
+        if (counts.numCounts() != 1 + outcome_names.size())
+            throw AnnotatedException(400, "Stats table file is corrupt");
+    }
 }
 
 
@@ -282,7 +346,7 @@ run(const ProcedureRunConfig & run,
                 }
                 else {
                     const tuple<ColumnPath, CellValue, Date> & col = row.columns[col_ptr->second];
-                    const StatsTable::BucketCounts & counts = it->second.increment(get<1>(col), encodedLabels);
+                    StatsTable::BucketCounts counts = it->second.increment(get<1>(col), encodedLabels);
 
                     // *******
                     // column name caching
@@ -307,13 +371,13 @@ run(const ProcedureRunConfig & run,
 
 
                     output_cols.emplace_back(colNames->at(0),
-                                             counts.first - 1,
+                                             counts.trials() - 1,
                                              get<2>(col));
 
                     // add all outcomes
                     for(int lbl_idx=0; lbl_idx<encodedLabels.size(); lbl_idx++) {
                         output_cols.emplace_back(colNames->at(lbl_idx+1),
-                                                 counts.second[lbl_idx] - encodedLabels[lbl_idx],
+                                                 counts.outcome(lbl_idx) - encodedLabels[lbl_idx],
                                                  get<2>(col));
                     }
                 }
@@ -392,9 +456,7 @@ StatsTableFunction(MldbEngine * owner,
     functionConfig = config.params.convert<StatsTableFunctionConfig>();
 
     // Load saved stats tables
-    filter_istream stream(functionConfig.modelFileUrl);
-    MLDB::DB::Store_Reader store(stream);
-    store >> statsTables;
+    statsTables = loadStatsTables(functionConfig.modelFileUrl);
 }
 
 StatsTableFunction::
@@ -439,14 +501,14 @@ apply(const FunctionApplier & applier,
                 if(st == statsTables.end())
                     return true;
 
-                const auto & counts = st->second.getCounts(val);
+                auto counts = st->second.getCounts(val);
 
-                rtnRow.emplace_back(PathElement("trial") + columnName, counts.first, ts);
+                rtnRow.emplace_back(PathElement("trial") + columnName, counts.trials(), ts);
 
                 for(int lbl_idx=0; lbl_idx<st->second.outcome_names.size(); lbl_idx++) {
                     rtnRow.emplace_back(PathElement(st->second.outcome_names[lbl_idx])
                                         +columnName,
-                                        counts.second[lbl_idx],
+                                        counts.outcome(lbl_idx),
                                         ts);
                 }
 
@@ -528,11 +590,7 @@ run(const ProcedureRunConfig & run,
         applyRunConfOverProcConf(procConfig, run);
 
     // Load saved stats tables
-    filter_istream stream(runProcConf.modelFileUrl);
-    MLDB::DB::Store_Reader store(stream);
-
-    StatsTablesMap statsTables;
-    store >> statsTables;
+    StatsTablesMap statsTables = loadStatsTables(runProcConf.modelFileUrl);
 
     /*******/
     // Expand the expression. this is painfully naive and slow for now
@@ -685,16 +743,25 @@ run(const ProcedureRunConfig & run,
             return onProgress(value);
         };
 
-    int num_req = 0;
+    std::atomic<int64_t> num_req(0);
+    std::mutex progressMutex;
     Date start = Date::now();
 
+    // Each thread counts into its own table, so that rows are processed
+    // in parallel without any locking; they are merged at the end.
+    PerThreadAccumulator<StringCountsTable> threadCounts
+        ([&] () { return new StringCountsTable(1 + outcome_names.size()); });
+
     auto processor = [&] (NamedRowValue & row_,
                            const std::vector<ExpressionValue> & extraVals)
         {
             MatrixNamedRow row = row_.flattenDestructive();
-            if(num_req++ % PROGRESS_RATE_LOW == 0) {
+            int64_t done = ++num_req;
+            if(done % PROGRESS_RATE_LOW == 0) {
+                std::unique_lock<std::mutex> guard(progressMutex);
                 double secs = Date::now().secondsSinceEpoch() - start.secondsSinceEpoch();
-                string message = MLDB::format("done %d. %0.4f/sec", num_req, num_req / secs);
+                string message = MLDB::format("done %lld. %0.4f/sec",
+                                              (long long)done, done / secs);
                 Json::Value progress;
                 progress["message"] = message;
                 onProgress2(progress);
@@ -707,8 +774,11 @@ run(const ProcedureRunConfig & run,
                 encodedLabels.push_back( !outcome.empty() && outcome.isTrue() );
             }
 
+            StringCountsTable & counts = threadCounts.get();
             for(const std::tuple<ColumnPath, CellValue, Date> & col : row.columns) {
-                statsTable.increment(CellValue(get<0>(col).toUtf8String()), encodedLabels);
+                Utf8String word = get<0>(col).toUtf8String();
+                StatsTable::incrementKey(counts, word.rawData(),
+                                         word.rawLength(), encodedLabels);
             }
 
             return true;
@@ -725,11 +795,19 @@ run(const ProcedureRunConfig & run,
                    runProcConf.trainingData.stm->when,
                    *runProcConf.trainingData.stm->where,
                    extra,
-                   {processor,false/*processInParallel*/},
+                   {processor,true/*processInParallel*/},
                    runProcConf.trainingData.stm->orderBy,
                    runProcConf.trainingData.stm->offset,
                    runProcConf.trainingData.stm->limit);
 
+    std::vector<const StringCountsTable *> shards;
+    threadCounts.forEach([&] (StringCountsTable * shard)
+                         {
+                             shards.push_back(shard);
+                         });
+    statsTable.counts
+        = StringCountsTable::merge(shards, 1 + outcome_names.size());
+
     // Optionally save counts to a dataset
     if (runProcConf.outputDataset) {
         Date date0;
@@ -740,8 +818,6 @@ run(const ProcedureRunConfig & run,
         auto output = createDataset(engine, outputDatasetConf, onProgress2,
                                     true /*overwrite*/);
 
-        uint64_t load_factor = std::ceil(statsTable.counts.load_factor());
-
         vector<ColumnPath> outcome_col_names;
         outcome_col_names.reserve(statsTable.outcome_names.size());
         for (int i=0; i < statsTable.outcome_names.size(); ++i)
@@ -750,34 +826,30 @@ run(const ProcedureRunConfig & run,
 
         typedef std::vector<std::tuple<ColumnPath, CellValue, Date>> Columns;
 
-        auto onBucketChunk = [&] (size_t i0, size_t i1)
+        auto onEntryChunk = [&] (size_t i0, size_t i1)
         {
             std::vector<std::pair<RowPath, Columns>> rows;
-            rows.reserve((i1 - i0)*load_factor);
-            // for each bucket of the unordered_map in our chunk
+            rows.reserve(i1 - i0);
             for (size_t i = i0; i < i1; ++i) {
-                // for each item in the bucket
-                for (auto it = statsTable.counts.begin(i);
-                        it != statsTable.counts.end(i); ++it) {
-                    Columns columns;
-                    // number of trials
-                    columns.emplace_back(PathElement("trials"), it->second.first, date0);
-                    // coocurence with outcome for each outcome
-                    for (int i=0; i < statsTable.outcome_names.size(); ++i) {
-                        columns.emplace_back(
-                            outcome_col_names[i],
-                            it->second.second[i],
-                            date0);
-                    }
-                    rows.emplace_back(PathElement(it->first), columns);
+                auto counts = statsTable.entryCounts(i);
+                Columns columns;
+                // number of trials
+                columns.emplace_back(PathElement("trials"), counts.trials(), date0);
+                // coocurence with outcome for each outcome
+                for (int j=0; j < statsTable.outcome_names.size(); ++j) {
+                    columns.emplace_back(
+                        outcome_col_names[j],
+                        counts.outcome(j),
+                        date0);
                 }
+                rows.emplace_back(PathElement(statsTable.key(i)),
+                                  std::move(columns));
             }
             output->recordRows(rows);
-            return true;
         };
 
-        parallelMapChunked(0, statsTable.counts.bucket_count(),
-                           256 /* chunksize */, onBucketChunk);
+        parallelMapChunked(0, statsTable.size(),
+                           1024 /* chunksize */, onEntryChunk);
         output->commit();
     }
 
@@ -840,12 +912,8 @@ StatsTablePosNegFunction(MldbEngine * owner,
 {
     functionConfig = config.params.convert<StatsTablePosNegFunctionConfig>();
 
-    StatsTable statsTable;
-
     // Load saved stats tables
-    filter_istream stream(functionConfig.modelFileUrl);
-    MLDB::DB::Store_Reader store(stream);
-    store >> statsTable;
+    StatsTable statsTable = loadStatsTable(functionConfig.modelFileUrl);
 
     // find the index of the outcome we're requesting in the config
     int outcomeToUseIdx = -1;
@@ -861,14 +929,14 @@ StatsTablePosNegFunction(MldbEngine * owner,
 
     // sort all the keys by their p(outcome)
     vector<pair<Utf8String, float>> accum;
-    for(auto it = statsTable.counts.begin(); it!=statsTable.counts.end(); it++) {
-        const pair<int64_t, std::vector<int64_t>> & counts = it->second;
+    for(size_t i = 0; i < statsTable.size(); i++) {
+        auto counts = statsTable.entryCounts(i);
 
-        if(counts.first < functionConfig.minTrials)
+        if(counts.trials() < functionConfig.minTrials)
             continue;
 
-        float poutcome = counts.second[outcomeToUseIdx] / float(counts.first);
-        accum.push_back(make_pair(it->first, poutcome));
+        float poutcome = counts.outcome(outcomeToUseIdx) / float(counts.trials());
+        accum.push_back(make_pair(statsTable.key(i), poutcome));
     }
 
     if(accum.size() < functionConfig.numPos + functionConfig.numNeg) {
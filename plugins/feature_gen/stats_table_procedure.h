@@ -16,7 +16,7 @@
 #include "sql/sql_expression.h"
 #include "mldb/types/db/persistent_fwd.h"
 #include "mldb/types/optional.h"
-#include <unordered_map>
+#include "mldb/utils/string_counts_table.h"
 
 namespace MLDB {
 
@@ -32,29 +32,57 @@ struct StatsTable {
     StatsTable(const ColumnPath & colName=ColumnPath("ND"),
             const std::vector<std::string> & outcome_names = {})
         : colName(colName), outcome_names(outcome_names),
-          zeroCounts(std::make_pair(0, std::vector<int64_t>(outcome_names.size())))
+          counts(1 + outcome_names.size())
     {
     }
 
     StatsTable(const std::string & filename);
 
-    // .first : nb trial
-    // .second : nb of occurence of each outcome
-    typedef std::pair<int64_t, std::vector<int64_t>> BucketCounts;
-    const BucketCounts & increment(const CellValue & val,
-                                   const std::vector<uint> & outcomes);
-    const BucketCounts & getCounts(const CellValue & val) const;
+    /// View of the counts of a key, which live in the counts table.  The
+    /// trials come first, followed by one count per outcome.
+    struct BucketCounts {
+        const int64_t * data;
+
+        // nb trial
+        int64_t trials() const { return data[0]; }
+        // nb of occurence of outcome i
+        int64_t outcome(size_t i) const { return data[1 + i]; }
+    };
+
+    BucketCounts increment(const CellValue & val,
+                           const std::vector<uint> & outcomes);
+    BucketCounts getCounts(const CellValue & val) const;
+
+    /// Number of distinct keys in the table
+    size_t size() const { return counts.size(); }
+
+    /// Key and counts of the given entry, in no particular order
+    Utf8String key(size_t entry) const;
+    BucketCounts entryCounts(size_t entry) const
+    {
+        return { counts.counts(entry) };
+    }
+
+    /// Add one trial of the key with the given outcomes to the table
+    static BucketCounts incrementKey(StringCountsTable & counts,
+                                     const char * key, size_t len,
+                                     const std::vector<uint> & outcomes);
 
     void save(const std::string & filename) const;
     void serialize(MLDB::DB::Store_Writer & store) const;
-    void reconstitute(MLDB::DB::Store_Reader & store);
+
+    /** Reconstitute from the store.  See StringCountsTable::reconstitute()
+        for the meaning of mapping.
+    */
+    void reconstitute(MLDB::DB::Store_Reader & store,
+                      std::shared_ptr<const void> mapping = nullptr);
 
     ColumnPath colName;
 
     std::vector<std::string> outcome_names;
-    std::unordered_map<Utf8String, BucketCounts> counts;
 
-    BucketCounts zeroCounts;
+    /// Trials followed by the outcome counts for each key
+    StringCountsTable counts;
 };
 
 
@@ -92,6 +120,18 @@ DECLARE_STRUCTURE_DESCRIPTION(StatsTableProcedureConfig);
 
 typedef std::map<ColumnPath, StatsTable> StatsTablesMap;
 
+/** Load the stats tables saved by statsTable.train.  Uncompressed local
+    files are memory mapped and the tables used in place, so that loading
+    is immediate and the pages are shared between all of the processes
+    that load the same file.
+*/
+StatsTablesMap loadStatsTables(const Url & url);
+
+/** Load the single stats table saved by statsTable.bagOfWords.train, in
+    the same way as loadStatsTables().
+*/
+StatsTable loadStatsTable(const Url & url);
+
 struct StatsTableProcedure: public Procedure {
 
     StatsTableProcedure(MldbEngine * owner,
@@ -74,6 +74,10 @@ ParseUserAgentFunction(MldbEngine * owner,
     functionConfig = config.params.convert<ParseUserAgentFunctionConfig>();
 
     parser = make_shared<UaParser::UserAgentParser>(functionConfig.regexFile);
+
+    // Parsing runs a long list of regexes, and real data has few distinct
+    // user agents
+    setDefaultCacheSize(10000);
 }
 
     
@@ -91,13 +91,48 @@ AccuracyConfigDescription()
               "Calculate a recall score over the top scoring labels."
               "Does not apply to boolean or regression modes.");
     
+    addField("streaming", &AccuracyConfig::streaming,
+             "If true, the scores are accumulated into a histogram of "
+             "bounded size instead of being kept in memory and sorted, which "
+             "allows for very large test sets.  Only the `boolean` mode "
+             "supports this.  The output dataset then has a row per unique "
+             "score, as with `uniqueScoresOnly`.", false);
+    addField("scorePrecisionBits", &AccuracyConfig::scorePrecisionBits,
+             "When `streaming` is true and there are more than "
+             "`maxExactScores` distinct scores, the scores are rounded to "
+             "this many significant bits.  The statistics are then those "
+             "of the rounded scores.", 12);
+    addField("maxExactScores", &AccuracyConfig::maxExactScores,
+             "When `streaming` is true, the statistics are exact as long as "
+             "there are no more than this many distinct scores.", 100000);
+
     addParent<ProcedureConfig>();
 
-    onPostValidate = validateQuery(&AccuracyConfig::testingData,
-                                   NoGroupByHaving(),
-                                   PlainColumnSelect(),
-                                   ScoreLabelSelect(),
-                                   MustContainFrom());
+    std::function<void (AccuracyConfig *, JsonParsingContext &)>
+        validateStreaming = [] (AccuracyConfig * config,
+                                JsonParsingContext & context)
+        {
+            if (config->streaming && config->mode != CM_BOOLEAN)
+                throw AnnotatedException
+                    (400, "The classifier.test `streaming` parameter is only "
+                     "supported in `boolean` mode");
+            if (config->scorePrecisionBits < 1
+                || config->scorePrecisionBits > 24)
+                throw AnnotatedException
+                    (400, "The classifier.test `scorePrecisionBits` must be "
+                     "between 1 and 24");
+            if (config->maxExactScores < 0)
+                throw AnnotatedException
+                    (400, "The classifier.test `maxExactScores` must not be "
+                     "negative");
+        };
+
+    onPostValidate = chain(validateQuery(&AccuracyConfig::testingData,
+                                         NoGroupByHaving(),
+                                         PlainColumnSelect(),
+                                         ScoreLabelSelect(),
+                                         MustContainFrom()),
+                           validateStreaming);
 
 }
 
@@ -125,6 +160,46 @@ getStatus() const
     return Any();
 }
 
+/** Columns of the output dataset for the stats of a boolean classifier at
+    the threshold of the given example's score. */
+static std::vector<std::tuple<ColumnPath, CellValue, Date> >
+booleanStatsRow(unsigned i, const BinaryStats & bstats,
+                bool label, float score, float weight, Date recordDate)
+{
+    std::vector<std::tuple<ColumnPath, CellValue, Date> > row;
+
+    row.emplace_back(ColumnPath("index"), i, recordDate);
+    row.emplace_back(ColumnPath("label"), label, recordDate);
+    row.emplace_back(ColumnPath("score"), score, recordDate);
+    row.emplace_back(ColumnPath("weight"), weight, recordDate);
+    row.emplace_back(ColumnPath("truePositives"), bstats.truePositives(), recordDate);
+    row.emplace_back(ColumnPath("falsePositives"), bstats.falsePositives(), recordDate);
+    row.emplace_back(ColumnPath("trueNegatives"), bstats.trueNegatives(), recordDate);
+    row.emplace_back(ColumnPath("falseNegatives"), bstats.falseNegatives(), recordDate);
+    row.emplace_back(ColumnPath("accuracy"), bstats.accuracy(), recordDate);
+    row.emplace_back(ColumnPath("precision"), bstats.precision(), recordDate);
+    row.emplace_back(ColumnPath("recall"), bstats.recall(), recordDate);
+    row.emplace_back(ColumnPath("truePositiveRate"), bstats.truePositiveRate(), recordDate);
+    row.emplace_back(ColumnPath("falsePositiveRate"), bstats.falsePositiveRate(), recordDate);
+
+    return row;
+}
+
+static void logBooleanStats(const ScoredStats & stats)
+{
+    auto logger = MLDB::getMldbLog<AccuracyProcedure>();
+
+    DEBUG_MSG(logger) << "stats are ";
+
+    DEBUG_MSG(logger) << stats.toJson();
+
+    DEBUG_MSG(logger) << stats.atPercentile(0.50).toJson();
+    DEBUG_MSG(logger) << stats.atPercentile(0.20).toJson();
+    DEBUG_MSG(logger) << stats.atPercentile(0.10).toJson();
+    DEBUG_MSG(logger) << stats.atPercentile(0.05).toJson();
+    DEBUG_MSG(logger) << stats.atPercentile(0.01).toJson();
+}
+
 RunOutput
 runBoolean(AccuracyConfig & runAccuracyConf,
            BoundSelectQuery & selectQuery,
@@ -178,23 +253,9 @@ runBoolean(AccuracyConfig & runAccuracyConf,
 
         auto recordRow = [&] (unsigned i, const BinaryStats & bstats, ScoredStats::ScoredEntry & entry)
         {
-            std::vector<std::tuple<RowPath, CellValue, Date> > row;
-
-            row.emplace_back(ColumnPath("index"), i, recordDate);
-            row.emplace_back(ColumnPath("label"), entry.label, recordDate);
-            row.emplace_back(ColumnPath("score"), entry.score, recordDate);
-            row.emplace_back(ColumnPath("weight"), entry.weight, recordDate);
-            row.emplace_back(ColumnPath("truePositives"), bstats.truePositives(), recordDate);
-            row.emplace_back(ColumnPath("falsePositives"), bstats.falsePositives(), recordDate);
-            row.emplace_back(ColumnPath("trueNegatives"), bstats.trueNegatives(), recordDate);
-            row.emplace_back(ColumnPath("falseNegatives"), bstats.falseNegatives(), recordDate);
-            row.emplace_back(ColumnPath("accuracy"), bstats.accuracy(), recordDate);
-            row.emplace_back(ColumnPath("precision"), bstats.precision(), recordDate);
-            row.emplace_back(ColumnPath("recall"), bstats.recall(), recordDate);
-            row.emplace_back(ColumnPath("truePositiveRate"), bstats.truePositiveRate(), recordDate);
-            row.emplace_back(ColumnPath("falsePositiveRate"), bstats.falsePositiveRate(), recordDate);
-
-            rows.emplace_back(std::any_cast<RowPath>(entry.key), std::move(row));
+            rows.emplace_back(std::any_cast<RowPath>(entry.key),
+                              booleanStatsRow(i, bstats, entry.label, entry.score,
+                                              entry.weight, recordDate));
             if (rows.size() > 10000) {
                 output->recordRows(rows);
                 rows.clear();
@@ -232,17 +293,101 @@ runBoolean(AccuracyConfig & runAccuracyConf,
         output->commit();
     }
 
-    DEBUG_MSG(logger) << "stats are ";
+    logBooleanStats(stats);
 
-    DEBUG_MSG(logger) << stats.toJson();
+    return Any(stats.toJson());
+}
 
-    DEBUG_MSG(logger) << stats.atPercentile(0.50).toJson();
-    DEBUG_MSG(logger) << stats.atPercentile(0.20).toJson();
-    DEBUG_MSG(logger) << stats.atPercentile(0.10).toJson();
-    DEBUG_MSG(logger) << stats.atPercentile(0.05).toJson();
-    DEBUG_MSG(logger) << stats.atPercentile(0.01).toJson();
+/** Same as runBoolean(), but accumulates the scores into per-thread
+    histograms of bounded size that are merged together, instead of keeping
+    and sorting every scored example.
+*/
+RunOutput
+runBooleanStreaming(AccuracyConfig & runAccuracyConf,
+                    BoundSelectQuery & selectQuery,
+                    std::shared_ptr<Dataset> output)
+{
+    PerThreadAccumulator<ScoreHistogram> accum([&] ()
+        {
+            return new ScoreHistogram(runAccuracyConf.scorePrecisionBits,
+                                      runAccuracyConf.maxExactScores);
+        });
 
-    return Any(stats.toJson());
+    auto processor = [&] (NamedRowValue & row,
+                          const std::vector<ExpressionValue> & scoreLabelWeight)
+        {
+            double score = scoreLabelWeight[0].toDouble();
+            bool label = scoreLabelWeight[1].asBool();
+            double weight = scoreLabelWeight[2].toDouble();
+
+            if (std::isnan(score))
+                throw AnnotatedException(400, "Classifier returned a NaN score",
+                                         "rowName", row.rowName);
+
+            accum.get().update(label, score, weight, row.rowName);
+
+            return true;
+        };
+
+    selectQuery.execute({processor,true/*processInParallel*/}, runAccuracyConf.testingData.stm->offset,
+             runAccuracyConf.testingData.stm->limit,
+             nullptr /* progress */);
+
+    if (accum.threads.empty()) {
+        throw MLDB::Exception(NO_DATA_ERR_MSG);
+    }
+
+    // Merge the histograms together pairwise, in parallel
+    parallelMergeSortRecursive(accum.threads, 0, accum.threads.size(),
+                               [] (const std::shared_ptr<ScoreHistogram> & h)
+                               {
+                               },
+                               [] (const std::shared_ptr<ScoreHistogram> & h1,
+                                   const std::shared_ptr<ScoreHistogram> & h2)
+                               {
+                                   h1->add(*h2);
+                               },
+                               [] (const std::shared_ptr<ScoreHistogram> & h)
+                               {
+                                   return h->size();
+                               },
+                               10000 /* thread threshold */);
+
+    const ScoreHistogram & histogram = *accum.threads[0];
+
+    ScoredStats stats;
+    stats.calculate(histogram);
+
+    if(output) {
+        const Date recordDate = Date::now();
+
+        Rows rows;
+
+        auto buckets = histogram.sorted();
+        ExcAssertEqual(stats.stats.size(), buckets.size() + 1);
+
+        for (unsigned i = 1;  i < stats.stats.size();  ++i) {
+            const ScoreHistogram::Bucket & bucket = *buckets[i - 1].second;
+            rows.emplace_back(std::any_cast<RowPath>(bucket.key),
+                              booleanStatsRow(i, stats.stats[i], bucket.label,
+                                              buckets[i - 1].first, bucket.weight,
+                                              recordDate));
+            if (rows.size() > 10000) {
+                output->recordRows(rows);
+                rows.clear();
+            }
+        }
+
+        output->recordRows(rows);
+
+        output->commit();
+    }
+
+    logBooleanStats(stats);
+
+    Json::Value result = stats.toJson();
+    result["exact"] = histogram.isExact();
+    return Any(result);
 }
 
 RunOutput
@@ -987,6 +1132,8 @@ run(const ProcedureRunConfig & run,
                      runAccuracyConf.testingData.stm->orderBy,
                      calc);
 
+    if(runAccuracyConf.mode == CM_BOOLEAN && runAccuracyConf.streaming)
+        return runBooleanStreaming(runAccuracyConf, boundQuery, output);
     if(runAccuracyConf.mode == CM_BOOLEAN)
         return runBoolean(runAccuracyConf, boundQuery, output);
     if(runAccuracyConf.mode == CM_CATEGORICAL)
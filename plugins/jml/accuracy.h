@@ -37,6 +37,15 @@ struct AccuracyConfig : public ProcedureConfig {
     //check if label is among the 'N' top scores
     std::vector<size_t> accuracyOverN;
 
+    /// Accumulate boolean scores into histograms instead of keeping them all
+    bool streaming = false;
+
+    /// Significant bits of the scores kept once a histogram can't be exact
+    int scorePrecisionBits = 12;
+
+    /// Maximum number of distinct scores for a histogram to be exact
+    int maxExactScores = 100000;
+
     /// Dataset we output to
     Optional<PolyConfigT<Dataset> > outputDataset;
     static constexpr char const * defaultOutputDatasetType = "tabular";
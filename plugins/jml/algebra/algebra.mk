@@ -3,6 +3,7 @@
 LIBALGEBRA_SOURCES := \
         least_squares.cc \
         irls.cc \
+        sparse_irls.cc \
         lapack.cc \
 	ilaenv.c \
         svd.cc \
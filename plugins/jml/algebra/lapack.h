@@ -120,7 +120,11 @@ int geqp3(int m, int n, float * A, int lda, int * jpvt, float * tau);
 int geqp3(int m, int n, double * A, int lda, int * jpvt, double * tau);
 
 
-/** Generalized matrix multiply */
+/** Generalized matrix multiply: C = alpha * op(A) * op(b) + beta * C,
+    where op(X) is X or its transpose depending upon trans ('N' or 'T').
+    Matrices are column major, as for the rest of LAPACK; a row major
+    matrix is seen as its transpose.  Always returns zero.
+*/
 int gemm(char transa, char transb, int m, int n, int k, float alpha,
          const float * A, int lda, const float * b, int ldb,
          float beta, float * C, int ldc);
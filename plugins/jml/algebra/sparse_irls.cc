@@ -0,0 +1,370 @@
+/* sparse_irls.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Iteratively Reweighted Least Squares on sparse data.
+*/
+
+#include "sparse_irls.h"
+#include "glz.h"
+#include "mldb/base/parallel.h"
+#include "mldb/arch/exception.h"
+#include "mldb/utils/string_functions.h"
+#include <cmath>
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* SPARSE_COLUMNS                                                            */
+/*****************************************************************************/
+
+size_t
+Sparse_Columns::
+nonzero_count() const
+{
+    size_t result = 0;
+    for (auto & c: columns)
+        result += c.size();
+    return result;
+}
+
+void
+Sparse_Columns::
+scale(const distribution<double> & scale)
+{
+    if (scale.size() != columns.size())
+        throw Exception("Sparse_Columns::scale(): wrong size");
+
+    auto onColumn = [&] (size_t v)
+        {
+            for (float & val: columns[v].values)
+                val *= scale[v];
+        };
+
+    MLDB::parallelMap(0, columns.size(), onColumn);
+}
+
+distribution<double>
+Sparse_Columns::
+apply(const distribution<double> & b) const
+{
+    if (b.size() != columns.size())
+        throw Exception("Sparse_Columns::apply(): wrong size");
+
+    distribution<double> result(nx, 0.0);
+    for (unsigned v = 0;  v < columns.size();  ++v) {
+        if (b[v] == 0.0)
+            continue;
+        const Column & c = columns[v];
+        for (unsigned k = 0;  k < c.size();  ++k)
+            result[c.examples[k]] += c.values[k] * b[v];
+    }
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* SPARSE IRLS                                                               */
+/*****************************************************************************/
+
+namespace {
+
+// Examples are processed in chunks of this size
+static constexpr size_t EXAMPLE_CHUNK = 4096;
+
+// Variables are processed in chunks of this size
+static constexpr size_t VARIABLE_CHUNK = 256;
+
+double variance(const Binomial_Dist<double> &, double mu)
+{
+    // Same clamping as Binomial_Dist::variance(Vector)
+    mu = std::min(std::max(mu, 0.0001), 0.9999);
+    return mu - mu * mu;
+}
+
+double variance(const Normal_Dist<double> &, double mu)
+{
+    return 1.0;
+}
+
+double deviance(const Binomial_Dist<double> &, double y, double mu)
+{
+    mu = std::min(std::max(mu, 1e-10), 1.0 - 1e-10);
+    double result = 0.0;
+    if (y != 0.0)
+        result += y * std::log(y / mu);
+    if (y != 1.0)
+        result += (1.0 - y) * std::log((1.0 - y) / (1.0 - mu));
+    return 2.0 * result;
+}
+
+double deviance(const Normal_Dist<double> &, double y, double mu)
+{
+    return (y - mu) * (y - mu);
+}
+
+template<class Link, class Dist>
+distribution<double>
+sparse_irls_impl(const Sparse_Columns & x,
+                 const distribution<double> & y,
+                 const distribution<double> & w,
+                 Regularization regularization,
+                 double regularization_factor,
+                 int bias,
+                 int maxIter,
+                 double epsilon,
+                 const distribution<double> * start)
+{
+    static const int max_irls_iter = 20;       // as for irls()
+    static const double tolerance = 5e-5;      // as for irls()
+
+    Dist dist;
+
+    size_t nv = x.variable_count();
+    size_t nx = x.example_count();
+
+    if (y.size() != nx || w.size() != nx)
+        throw Exception("sparse_irls(): incompatible data sizes");
+    if (start && start->size() != nv)
+        throw Exception("sparse_irls(): wrong number of starting parameters");
+
+    double lambda = 0.0;
+    if (regularization == Regularization_l1
+        || regularization == Regularization_l2)
+        lambda = regularization_factor * w.total();
+    else if (regularization != Regularization_none)
+        throw Exception("sparse_irls(): unknown regularization method");
+
+    distribution<double> b(nv, 0.0);  // parameters
+    distribution<double> xb(nx, 0.0); // b * x
+    distribution<double> eta(nx);     // link output
+    distribution<double> mu(nx);      // link input
+
+    if (start) {
+        b = *start;
+        xb = x.apply(b);
+        for (unsigned i = 0;  i < nx;  ++i) {
+            eta[i] = xb[i];
+            mu[i] = Link::inverse(eta[i]);
+        }
+    }
+    else {
+        for (unsigned i = 0;  i < nx;  ++i) {
+            mu[i] = (y[i] + 0.5) / 2;
+            eta[i] = Link::forward(mu[i]);
+        }
+    }
+
+    distribution<double> fw(nx);      // fit weights
+    distribution<double> z(nx);       // working response
+    distribution<double> r(nx);       // residual z - b * x
+    distribution<double> h(nv);       // diagonal of X'WX
+
+    double last_dev = INFINITY;
+
+    for (int iter = 0;  iter < max_irls_iter;  ++iter) {
+
+        /* Find the new weights and working response for this iteration. */
+        auto onExamples = [&] (size_t i0, size_t i1)
+            {
+                for (size_t i = i0;  i < i1;  ++i) {
+                    double deta_dmu = Link::diff(mu[i]);
+                    fw[i] = w[i] / (deta_dmu * deta_dmu * variance(dist, mu[i]));
+                    z[i] = eta[i] + (y[i] - mu[i]) * deta_dmu;
+                    r[i] = z[i] - xb[i];
+                }
+            };
+
+        MLDB::parallelMapChunked(0, nx, EXAMPLE_CHUNK, onExamples);
+
+        double total_fw = 0.0;
+        for (unsigned i = 0;  i < nx;  ++i) {
+            if (!std::isfinite(fw[i]) || !std::isfinite(r[i]))
+                throw Exception(format("sparse_irls(): fit_weights[%d] = %f",
+                                       i, fw[i]));
+            total_fw += fw[i];
+        }
+
+        /* Diagonal of X'WX, which is all that coordinate descent needs. */
+        auto onVariables = [&] (size_t v0, size_t v1)
+            {
+                for (size_t v = v0;  v < v1;  ++v) {
+                    const Sparse_Columns::Column & c = x.columns[v];
+                    double total = 0.0;
+                    for (unsigned k = 0;  k < c.size();  ++k)
+                        total += fw[c.examples[k]] * c.values[k] * c.values[k];
+                    h[v] = total;
+                }
+            };
+
+        MLDB::parallelMapChunked(0, nv, VARIABLE_CHUNK, onVariables);
+
+        /* Solve the reweighted problem by coordinate descent, keeping the
+           residual up to date as each variable changes. */
+        for (int pass = 0;  pass < maxIter;  ++pass) {
+            double max_change = 0.0;
+
+            for (unsigned v = 0;  v < nv;  ++v) {
+                if (h[v] <= 0.0)
+                    continue;
+
+                const Sparse_Columns::Column & c = x.columns[v];
+
+                double g = h[v] * b[v];
+                for (unsigned k = 0;  k < c.size();  ++k)
+                    g += fw[c.examples[k]] * c.values[k] * r[c.examples[k]];
+
+                double l = (v == bias ? 0.0 : lambda);
+                double bv;
+                if (regularization == Regularization_l1) {
+                    if (g > l) bv = (g - l) / h[v];
+                    else if (g < -l) bv = (g + l) / h[v];
+                    else bv = 0.0;
+                }
+                else bv = g / (h[v] + l);
+
+                double delta = bv - b[v];
+                if (delta == 0.0)
+                    continue;
+
+                b[v] = bv;
+                for (unsigned k = 0;  k < c.size();  ++k)
+                    r[c.examples[k]] -= c.values[k] * delta;
+
+                // RMS change of the linear predictor due to this variable
+                max_change = std::max(max_change,
+                                      std::abs(delta)
+                                      * std::sqrt(h[v] / total_fw));
+            }
+
+            if (max_change < epsilon)
+                break;
+        }
+
+        /* Re-estimate eta and mu based on refined estimate.  The linear
+           predictor is recalculated rather than taken from the residuals
+           to avoid accumulating rounding errors. */
+        xb = x.apply(b);
+
+        double dev = 0.0;
+        for (unsigned i = 0;  i < nx;  ++i) {
+            eta[i] = xb[i];
+            mu[i] = Link::inverse(eta[i]);
+            if (!std::isfinite(mu[i]))
+                throw Exception(format("sparse_irls(): mu[%d] = %f", i, mu[i]));
+            dev += w[i] * deviance(dist, y[i], mu[i]);
+        }
+
+        if (std::abs(dev - last_dev) < tolerance * (std::abs(dev) + 0.1))
+            break;
+        last_dev = dev;
+    }
+
+    return b;
+}
+
+} // file scope
+
+distribution<double>
+sparse_irls(const Sparse_Columns & x,
+            const distribution<double> & correct,
+            const distribution<double> & w,
+            Link_Function link_function,
+            Regularization regularization,
+            double regularization_factor,
+            int bias,
+            int maxIter,
+            double epsilon,
+            const distribution<double> * start)
+{
+    switch (link_function) {
+
+    case LOGIT:
+        return sparse_irls_impl<Logit_Link<double>, Binomial_Dist<double> >
+            (x, correct, w, regularization, regularization_factor, bias,
+             maxIter, epsilon, start);
+
+    case LOG:
+        return sparse_irls_impl<Logarithm_Link<double>, Binomial_Dist<double> >
+            (x, correct, w, regularization, regularization_factor, bias,
+             maxIter, epsilon, start);
+
+    case LINEAR:
+        return sparse_irls_impl<Linear_Link<double>, Normal_Dist<double> >
+            (x, correct, w, regularization, regularization_factor, bias,
+             maxIter, epsilon, start);
+
+    case PROBIT:
+        return sparse_irls_impl<Probit_Link<double>, Binomial_Dist<double> >
+            (x, correct, w, regularization, regularization_factor, bias,
+             maxIter, epsilon, start);
+
+    case COMP_LOG_LOG:
+        return sparse_irls_impl<Comp_Log_Log_Link<double>,
+                                Binomial_Dist<double> >
+            (x, correct, w, regularization, regularization_factor, bias,
+             maxIter, epsilon, start);
+
+    default:
+        throw Exception(format("sparse_irls(): function %d "
+                               "not implemented", link_function));
+    }
+}
+
+std::vector<distribution<double> >
+sparse_irls(const Sparse_Columns & x,
+            const std::vector<distribution<double> > & correct,
+            const std::vector<distribution<double> > & w,
+            Link_Function link_function,
+            Regularization regularization,
+            double regularization_factor,
+            int bias,
+            int maxIter,
+            double epsilon)
+{
+    if (correct.size() != w.size())
+        throw Exception("sparse_irls(): incompatible label counts");
+
+    std::vector<distribution<double> > result(correct.size());
+
+    auto onLabel = [&] (size_t l)
+        {
+            result[l] = sparse_irls(x, correct[l], w[l], link_function,
+                                    regularization, regularization_factor,
+                                    bias, maxIter, epsilon);
+        };
+
+    MLDB::parallelMap(0, correct.size(), onLabel);
+
+    return result;
+}
+
+std::vector<distribution<double> >
+sparse_irls_path(const Sparse_Columns & x,
+                 const distribution<double> & correct,
+                 const distribution<double> & w,
+                 Link_Function link_function,
+                 Regularization regularization,
+                 const std::vector<double> & regularization_factors,
+                 int bias,
+                 int maxIter,
+                 double epsilon)
+{
+    std::vector<distribution<double> > result;
+    result.reserve(regularization_factors.size());
+
+    for (double factor: regularization_factors) {
+        result.push_back(sparse_irls(x, correct, w, link_function,
+                                     regularization, factor, bias,
+                                     maxIter, epsilon,
+                                     result.empty() ? nullptr : &result.back()));
+    }
+
+    return result;
+}
+
+} // namespace ML
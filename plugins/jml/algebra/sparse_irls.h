@@ -0,0 +1,136 @@
+/* sparse_irls.h                                                   -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Iteratively Reweighted Least Squares on sparse data, with the weighted
+   least squares problem solved by coordinate descent.
+*/
+
+#pragma once
+
+#include <vector>
+#include "mldb/utils/distribution.h"
+#include "irls.h"
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* SPARSE_COLUMNS                                                            */
+/*****************************************************************************/
+
+/** A matrix of nv variables by nx examples, stored by variable with only
+    the non-zero values.  This is the sparse equivalent of the nv x nx
+    outputs matrix that perform_irls() takes.
+*/
+
+struct Sparse_Columns {
+    Sparse_Columns(size_t nv = 0, size_t nx = 0)
+        : columns(nv), nx(nx)
+    {
+    }
+
+    struct Column {
+        std::vector<int> examples;   ///< Examples with a non-zero value
+        std::vector<float> values;   ///< Value for each of those examples
+
+        void add(int example, float value)
+        {
+            examples.push_back(example);
+            values.push_back(value);
+        }
+
+        size_t size() const { return examples.size(); }
+    };
+
+    std::vector<Column> columns;
+    size_t nx;                       ///< Number of examples
+
+    size_t variable_count() const { return columns.size(); }
+    size_t example_count() const { return nx; }
+
+    /** Number of non-zero values. */
+    size_t nonzero_count() const;
+
+    /** Multiply each column by the corresponding entry of scale. */
+    void scale(const distribution<double> & scale);
+
+    /** Calculate eta = b * x, which has nx entries. */
+    distribution<double> apply(const distribution<double> & b) const;
+};
+
+
+/*****************************************************************************/
+/* SPARSE IRLS                                                               */
+/*****************************************************************************/
+
+/** Perform an IRLS directly on sparse data.  Instead of forming the nv x nv
+    matrix X'WX and solving it, which is impossible with many variables,
+    each of the reweighted least squares problems is solved by coordinate
+    descent, which only ever touches the non-zero values and so scales with
+    their number.  The steps that are done for every example or every
+    variable (the new weights, the diagonal of X'WX) are done in parallel.
+
+    The regularization minimizes, for each reweighted problem,
+
+        1/2 sum_i fw_i (z_i - x_i b)^2 + lambda |b|_1          (l1)
+        1/2 sum_i fw_i (z_i - x_i b)^2 + lambda/2 |b|^2        (l2)
+
+    where lambda is regularization_factor times the sum of the weights, so
+    that its effect doesn't depend upon the number of examples.
+
+    \param bias       Index of a variable (normally the bias) that isn't
+                      regularized, or -1 if they all are.
+    \param maxIter    Maximum number of coordinate descent passes over the
+                      variables per reweighted problem.
+    \param epsilon    Coordinate descent has converged once no variable's
+                      contribution to the linear predictor changes by more
+                      than this.
+    \param start      Initial parameters (warm start), or null to start
+                      from zero.
+
+    \returns          The parameters, one per variable.
+*/
+distribution<double>
+sparse_irls(const Sparse_Columns & x,
+            const distribution<double> & correct,
+            const distribution<double> & w,
+            Link_Function link_function,
+            Regularization regularization = Regularization_l2,
+            double regularization_factor = 1e-5,
+            int bias = -1,
+            int maxIter = 1000,
+            double epsilon = 1e-4,
+            const distribution<double> * start = nullptr);
+
+/** Same as above, but for several labels at once, each with its own target
+    and weights.  The labels are solved concurrently.
+*/
+std::vector<distribution<double> >
+sparse_irls(const Sparse_Columns & x,
+            const std::vector<distribution<double> > & correct,
+            const std::vector<distribution<double> > & w,
+            Link_Function link_function,
+            Regularization regularization = Regularization_l2,
+            double regularization_factor = 1e-5,
+            int bias = -1,
+            int maxIter = 1000,
+            double epsilon = 1e-4);
+
+/** Solve for each of the regularization factors in turn, each warm started
+    from the solution of the one before.  Going from the largest to the
+    smallest factor is much faster than solving for each separately,
+    especially for l1 where the solutions for large factors are very
+    sparse.  Returns one set of parameters per factor.
+*/
+std::vector<distribution<double> >
+sparse_irls_path(const Sparse_Columns & x,
+                 const distribution<double> & correct,
+                 const distribution<double> & w,
+                 Link_Function link_function,
+                 Regularization regularization,
+                 const std::vector<double> & regularization_factors,
+                 int bias = -1,
+                 int maxIter = 1000,
+                 double epsilon = 1e-4);
+
+} // namespace ML
@@ -0,0 +1,166 @@
+/* sparse_irls_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of IRLS on sparse data.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+
+#include <vector>
+#include <random>
+#include <iostream>
+
+#include "mldb/plugins/jml/algebra/sparse_irls.h"
+#include "mldb/plugins/jml/algebra/irls.h"
+
+using namespace ML;
+using namespace std;
+
+using boost::unit_test::test_suite;
+using namespace boost::test_tools;
+
+namespace {
+
+/** Random sparse binary problem with nv variables, the last of which is a
+    bias that is always 1.
+*/
+struct Problem {
+    Problem(int nv, int nx, double density, unsigned seed = 1)
+        : x(nv, nx), dense(boost::extents[nv][nx]), correct(nx), w(nx, 1.0)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        std::normal_distribution<double> normal;
+
+        distribution<double> truth(nv);
+        for (int v = 0;  v < nv;  ++v)
+            truth[v] = normal(rng);
+
+        for (int i = 0;  i < nx;  ++i) {
+            double eta = 0.0;
+            for (int v = 0;  v < nv;  ++v) {
+                double val = 0.0;
+                if (v == nv - 1)
+                    val = 1.0;
+                else if (uniform(rng) < density)
+                    val = (float)normal(rng);
+                dense[v][i] = val;
+                if (val != 0.0)
+                    x.columns[v].add(i, val);
+                eta += truth[v] * val;
+            }
+            correct[i] = uniform(rng) < 1.0 / (1.0 + exp(-eta));
+        }
+    }
+
+    Sparse_Columns x;
+    boost::multi_array<double, 2> dense;
+    distribution<double> correct;
+    distribution<double> w;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_sparse_irls_matches_dense )
+{
+    Problem p(10, 2000, 0.3);
+    BOOST_CHECK_EQUAL(p.x.example_count(), 2000);
+    BOOST_CHECK_EQUAL(p.x.variable_count(), 10);
+
+    // PROBIT needs erfinv(), which isn't available (see irls.cc)
+    for (auto link: { LOGIT, LINEAR }) {
+        distribution<double> dense
+            = perform_irls(p.correct, p.dense, p.w, link,
+                           Regularization_none, 0.0, 20, 1e-4,
+                           false /* condition */);
+        distribution<double> sparse
+            = sparse_irls(p.x, p.correct, p.w, link,
+                          Regularization_none, 0.0, 9 /* bias */,
+                          1000, 1e-8);
+
+        cerr << "link " << link << " dense " << dense << endl;
+        cerr << "link " << link << " sparse " << sparse << endl;
+
+        BOOST_REQUIRE_EQUAL(dense.size(), sparse.size());
+        for (unsigned v = 0;  v < dense.size();  ++v)
+            BOOST_CHECK_SMALL(dense[v] - sparse[v], 1e-3);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_irls_regularization )
+{
+    Problem p(50, 500, 0.1);
+
+    distribution<double> none
+        = sparse_irls(p.x, p.correct, p.w, LOGIT, Regularization_none, 0.0, 49);
+    distribution<double> l2
+        = sparse_irls(p.x, p.correct, p.w, LOGIT, Regularization_l2, 1e-2, 49);
+    distribution<double> l1
+        = sparse_irls(p.x, p.correct, p.w, LOGIT, Regularization_l1, 1e-2, 49);
+
+    // Regularization shrinks the parameters, and l1 zeroes some of them
+    BOOST_CHECK_LT(l2.two_norm(), none.two_norm());
+    int zeros = 0;
+    for (unsigned v = 0;  v < 49;  ++v)
+        zeros += l1[v] == 0.0;
+    BOOST_CHECK_GT(zeros, 0);
+
+    // A strong enough l1 penalty leaves only the bias
+    distribution<double> all
+        = sparse_irls(p.x, p.correct, p.w, LOGIT, Regularization_l1, 10.0, 49);
+    for (unsigned v = 0;  v < 49;  ++v)
+        BOOST_CHECK_EQUAL(all[v], 0.0);
+    BOOST_CHECK_NE(all[49], 0.0);
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_irls_multi_label )
+{
+    Problem p1(20, 1000, 0.2, 1);
+    Problem p2(20, 1000, 0.2, 2);
+
+    // Same features, different labels
+    vector<distribution<double> > correct = { p1.correct, p2.correct };
+    vector<distribution<double> > w = { p1.w, p2.w };
+
+    vector<distribution<double> > multi
+        = sparse_irls(p1.x, correct, w, LOGIT, Regularization_l2, 1e-4, 19);
+
+    BOOST_REQUIRE_EQUAL(multi.size(), 2);
+    for (unsigned l = 0;  l < 2;  ++l) {
+        distribution<double> single
+            = sparse_irls(p1.x, correct[l], w[l], LOGIT,
+                          Regularization_l2, 1e-4, 19);
+        BOOST_CHECK_EQUAL_COLLECTIONS(multi[l].begin(), multi[l].end(),
+                                      single.begin(), single.end());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_irls_path )
+{
+    Problem p(30, 1000, 0.2);
+
+    vector<double> factors = { 1e-1, 1e-2, 1e-3, 1e-4 };
+    vector<distribution<double> > path
+        = sparse_irls_path(p.x, p.correct, p.w, LOGIT, Regularization_l1,
+                           factors, 29, 1000, 1e-8);
+    BOOST_REQUIRE_EQUAL(path.size(), factors.size());
+
+    // The warm started solution is the same as solving from scratch
+    distribution<double> cold
+        = sparse_irls(p.x, p.correct, p.w, LOGIT, Regularization_l1,
+                      factors.back(), 29, 1000, 1e-8);
+
+    for (unsigned v = 0;  v < cold.size();  ++v)
+        BOOST_CHECK_SMALL(path.back()[v] - cold[v], 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_irls_bad_sizes )
+{
+    Problem p(5, 100, 0.5);
+    distribution<double> correct(99);
+    BOOST_CHECK_THROW(sparse_irls(p.x, correct, p.w, LOGIT), std::exception);
+}
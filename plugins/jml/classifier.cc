@@ -10,6 +10,7 @@
 #include "classifier.h"
 #include "mldb/plugins/jml/jml/classifier.h"
 #include "dataset_feature_space.h"
+#include "feature_set_store.h"
 #include "mldb/core/mldb_engine.h"
 #include "mldb/core/dataset.h"
 #include "mldb/engine/bound_queries.h"
@@ -132,6 +133,14 @@ ClassifierConfigDescription()
              "is a good number to use for unbalanced probabilities. "
              "See the [classifier configuration documentation](../ClassifierConf.md.html) for details.",
              0.5);
+    addField("spillTrainingData", &ClassifierConfig::spillTrainingData,
+             "If true, the training examples extracted from the dataset are "
+             "packed into a memory mapped temporary file (in the directory "
+             "given by the `MLDB_QUERY_SPILL_DIR` environment variable, by "
+             "default `/tmp`) instead of being held in memory, so that the "
+             "operating system can page them out when the training set is "
+             "larger than the available memory.  The trained model is the "
+             "same either way.", false);
     addField("modelFileUrl", &ClassifierConfig::modelFileUrl,
              "URL where the model file (with extension '.cls') should be saved. "
              "This file can be loaded by the ![](%%doclink classifier function). "
@@ -355,20 +364,28 @@ run(const ProcedureRunConfig & run,
     std::vector<std::shared_ptr<SqlExpression> > extra
         = { label, weight };
 
+    // The extracted features are packed into chunks of memory (or of a
+    // memory mapped file, if we're spilling), rather than each example
+    // having its own allocation.
+    std::shared_ptr<MappedSerializer> featureSetSerializer;
+    if (runProcConf.spillTrainingData)
+        featureSetSerializer = createFeatureSetSpillFile();
+    else featureSetSerializer = std::make_shared<MemorySerializer>();
+
     struct Fv {
         Fv()
         {
         }
 
         Fv(RowPath rowName,
-           ML::Mutable_Feature_Set featureSet)
+           StoredFeatureSet featureSet)
             : rowName(std::move(rowName)),
               featureSet(std::move(featureSet))
         {
         }
 
         RowPath rowName;
-        ML::Mutable_Feature_Set featureSet;
+        StoredFeatureSet featureSet;
 
         float label() const
         {
@@ -385,7 +402,7 @@ run(const ProcedureRunConfig & run,
         void setLabel(float label)
         {
             ExcAssertEqual(featureSet.at(0).first, labelFeature);
-            featureSet.at(0).second = label;
+            featureSet.entries[0].second = label;
         }
 
         bool operator < (const Fv & other) const
@@ -401,6 +418,12 @@ run(const ProcedureRunConfig & run,
 
     // Build it
     struct ThreadAccum {
+        ThreadAccum(std::shared_ptr<MappedSerializer> serializer)
+            : store(std::move(serializer))
+        {
+        }
+
+        FeatureSetStore store;
         std::vector<Fv> fvs;
 
         // These are for categorical variables only.  Since we need to create a
@@ -473,7 +496,10 @@ run(const ProcedureRunConfig & run,
 
     std::atomic<int> numRows(0);
 
-    PerThreadAccumulator<ThreadAccum> accum;
+    PerThreadAccumulator<ThreadAccum> accum([&] ()
+        {
+            return new ThreadAccum(featureSetSerializer);
+        });
 
     auto accumRow = [&] (float weight,
                          const MatrixNamedRow& row,
@@ -516,7 +542,9 @@ run(const ProcedureRunConfig & run,
             unique_known_features.insert(std::get<0>(c));
         }
 
-        thr.fvs.emplace_back(row.rowName, std::move(features));
+        thr.fvs.emplace_back(row.rowName,
+                             thr.store.add(ML::Mutable_Feature_Set
+                                           (std::move(features))));
     };
 
 
@@ -866,7 +894,7 @@ run(const ProcedureRunConfig & run,
                  "or preprocess your labels with `replace_not_finite(label, 0)`?");
         }
 
-        trainingSet.add_example(std::make_shared<ML::Mutable_Feature_Set>(std::move(fvs[i].featureSet)));
+        trainingSet.add_example(std::make_shared<StoredFeatureSet>(fvs[i].featureSet));
 
         if(runProcConf.mode != CM_REGRESSION) {
 
@@ -892,6 +920,9 @@ run(const ProcedureRunConfig & run,
 
     ExcAssertEqual(nx, trainingSet.example_count());
 
+    // The row names were only needed to sort the examples
+    std::vector<Fv>().swap(fvs);
+
     INFO_MSG(logger) << "added feature vectors in " << timer.elapsed();
 
     timer.restart();
@@ -1067,50 +1098,60 @@ getDetails() const
     return result;
 }
 
-std::tuple<std::vector<float>, std::shared_ptr<ML::Mutable_Feature_Set>, Date>
+bool
 ClassifyFunction::
-getFeatureSet(const ExpressionValue & context, bool attemptDense) const
+getDenseFeatures(const ExpressionValue & context,
+                 float * denseFeatures, Date & ts) const
 {
     auto row = context.getColumn(PathElement("features"));
 
-    Date ts = Date::negativeInfinity();
-
     bool multiValue = false;
-    if (attemptDense) {
-        std::vector<float> denseFeatures(itl->featureSpace->columnInfo.size(),
-                                         std::numeric_limits<float>::quiet_NaN());
 
-        auto onAtom = [&] (const Path & suffix,
-                           const Path & prefix,
-                           const CellValue & value,
-                           Date tsIn)
-            {
-                ColumnPath columnName(prefix + suffix);
-                ColumnHash columnHash(columnName);
-                
-                auto it = itl->featureSpace->columnInfo.find(columnHash);
-                if (it == itl->featureSpace->columnInfo.end())
-                    return true;
+    auto onAtom = [&] (const Path & suffix,
+                       const Path & prefix,
+                       const CellValue & value,
+                       Date tsIn)
+        {
+            ColumnPath columnName(prefix + suffix);
+            ColumnHash columnHash(columnName);
 
-                ts.setMax(tsIn);
+            auto it = itl->featureSpace->columnInfo.find(columnHash);
+            if (it == itl->featureSpace->columnInfo.end())
+                return true;
 
-                if (!isnanf(denseFeatures[it->second.index])) {
-                    multiValue = true;
-                    return false;
-                }
-                
-                denseFeatures[it->second.index]
-                    = itl->featureSpace->encodeFeatureValue(columnHash, value);
+            ts.setMax(tsIn);
 
-                return true;
-            };
+            if (!isnanf(denseFeatures[it->second.index])) {
+                multiValue = true;
+                return false;
+            }
+
+            denseFeatures[it->second.index]
+                = itl->featureSpace->encodeFeatureValue(columnHash, value);
+
+            return true;
+        };
 
-        row.forEachAtom(onAtom);
+    row.forEachAtom(onAtom);
+
+    return !multiValue;
+}
+
+std::tuple<std::vector<float>, std::shared_ptr<ML::Mutable_Feature_Set>, Date>
+ClassifyFunction::
+getFeatureSet(const ExpressionValue & context, bool attemptDense) const
+{
+    Date ts = Date::negativeInfinity();
+
+    if (attemptDense) {
+        std::vector<float> denseFeatures(itl->featureSpace->columnInfo.size(),
+                                         std::numeric_limits<float>::quiet_NaN());
 
-        if (!multiValue)
+        if (getDenseFeatures(context, denseFeatures.data(), ts))
             return std::make_tuple( std::move(denseFeatures), nullptr, ts );
     }
 
+    auto row = context.getColumn(PathElement("features"));
 
     std::vector<std::pair<ML::Feature, float> > features;
 
@@ -1253,6 +1294,94 @@ apply(const FunctionApplier & applier_,
     return std::move(result);
 }
 
+std::vector<ExpressionValue>
+ClassifyFunction::
+applyBatch(const FunctionApplier & applier_,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    auto & applier = (ClassifyFunctionApplier &)applier_;
+
+    if (!applier.optInfo)
+        return Function::applyBatch(applier_, inputs);
+
+    static constexpr float NaN = std::numeric_limits<float>::quiet_NaN();
+
+    size_t numFeatures = itl->featureSpace->columnInfo.size();
+    int labelCount = itl->classifier.label_count();
+    auto cat = itl->labelInfo.categorical();
+
+    std::vector<ExpressionValue> result(inputs.size());
+
+    // Gather the features of the inputs into a matrix with one row each.
+    // Inputs with a feature that has more than one value can't be
+    // represented densely, and are applied on their own.
+    std::vector<float> features(inputs.size() * numFeatures, NaN);
+    std::vector<Date> timestamps(inputs.size(), Date::negativeInfinity());
+    std::vector<size_t> denseInputs;
+    denseInputs.reserve(inputs.size());
+
+    for (size_t i = 0;  i < inputs.size();  ++i) {
+        float * row = features.data() + denseInputs.size() * numFeatures;
+        if (getDenseFeatures(inputs[i], row, timestamps[i])) {
+            denseInputs.push_back(i);
+        }
+        else {
+            std::fill(row, row + numFeatures, NaN);
+            result[i] = apply(applier, inputs[i]);
+        }
+    }
+
+    size_t scoresPerInput = cat ? labelCount : 1;
+    std::vector<float> scores(denseInputs.size() * scoresPerInput);
+
+    if (cat) {
+        itl->classifier.impl->predict_batch(features.data(), denseInputs.size(),
+                                            applier.optInfo, scores.data());
+    }
+    else {
+        // Regressions have one label; booleans predict P(true)
+        bool isReal = itl->labelInfo.type() == ML::REAL;
+        int expectedLabelCount = isReal ? 1 : 2;
+        ExcAssertEqual(labelCount, expectedLabelCount);
+        int label = isReal ? 0 : 1;
+        itl->classifier.impl->predict_batch(label, features.data(),
+                                            denseInputs.size(),
+                                            applier.optInfo, scores.data());
+    }
+
+    std::vector<PathElement> labelNames;
+    if (cat) {
+        for (unsigned i = 0;  i < labelCount;  ++i)
+            labelNames.emplace_back(cat->print(i));
+    }
+
+    for (size_t j = 0;  j < denseInputs.size();  ++j) {
+        size_t i = denseInputs[j];
+        Date ts = timestamps[i];
+        const float * inputScores = scores.data() + j * scoresPerInput;
+
+        StructValue output;
+        output.reserve(1);
+
+        if (cat) {
+            StructValue row;
+            row.reserve(labelCount);
+            for (unsigned k = 0;  k < labelCount;  ++k) {
+                row.emplace_back(labelNames[k],
+                                 ExpressionValue(inputScores[k], ts));
+            }
+            output.emplace_back("scores", std::move(row));
+        }
+        else {
+            output.emplace_back("score", ExpressionValue(inputScores[0], ts));
+        }
+
+        result[i] = std::move(output);
+    }
+
+    return result;
+}
+
 FunctionInfo
 ClassifyFunction::
 getFunctionInfo() const
@@ -1416,6 +1545,14 @@ apply(const FunctionApplier & applier,
     return std::move(output);
 }
 
+std::vector<ExpressionValue>
+ExplainFunction::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    return Function::applyBatch(applier, inputs);
+}
+
 FunctionInfo
 ExplainFunction::
 getFunctionInfo() const
@@ -74,6 +74,10 @@ struct ClassifierConfig : public ProcedureConfig {
     // Strategy to handle multilabel
     MultilabelStrategy multilabelStrategy = MULTILABEL_ONEVSALL;
 
+    /// Keep the extracted training examples in a memory mapped temporary
+    /// file rather than in memory, so that they can be paged out
+    bool spillTrainingData = false;
+
     // Function name
     Utf8String functionName;
 };
@@ -135,9 +139,25 @@ struct ClassifyFunction: public Function {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    /** Applies the classifier to a batch of inputs by gathering their
+        features into a dense matrix and predicting them all at once.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const;
+
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
 
+    /** Fill in the dense feature vector for the given function context,
+        which has one entry per feature (NaN for those that are missing)
+        and must be initialized to NaN.  ts is set to the latest timestamp
+        of the features.  Returns false if a feature has more than one
+        value, in which case the features can't be represented densely.
+    */
+    bool getDenseFeatures(const ExpressionValue & context,
+                          float * features, Date & ts) const;
+
     /** Return the feature set for the given function context.  If
         returnDense is true, then it will attempt to return an optimized
         (dense) feature vector.
@@ -174,6 +194,13 @@ struct ExplainFunction: public ClassifyFunction {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    /** Explanations are made one at a time, so this doesn't use the
+        batch prediction of the classify function.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const;
+
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
 };
@@ -16,9 +16,12 @@
 
 #include <random>
 #include <mutex>
+#include <atomic>
 
 #include "mldb/plugins/jml/algebra/matrix_ops.h"
 #include "mldb/plugins/jml/algebra/least_squares.h"
+#include "mldb/plugins/jml/algebra/lapack.h"
+#include "mldb/base/parallel.h"
 #include "mldb/types/jml_serialization.h"
 
 using namespace std;
@@ -34,78 +37,153 @@ double distance(const distribution<double> & x,
     return (x - y).two_norm();
 }
 
-double gaussianDistance(const distribution<double> & pt,
-                        const distribution<double> & origin,
-                        const MatrixType& covarianceMatrix, 
-                        const  MatrixType & invertCovarianceMatrix,
-                        float determinant)
+/** Log of the gaussian density at pt, up to the (2 pi)^(d/2) factor that
+    is the same for all clusters.  Working with the log avoids the density
+    underflowing to zero in more than a few dimensions.
+*/
+double logGaussianDensity(const distribution<double> & pt,
+                          const distribution<double> & origin,
+                          const MatrixType & invertCovarianceMatrix,
+                          double determinant)
 {
     auto xToU = pt - origin;
-    auto variance = invertCovarianceMatrix * xToU ;
-
-    double value_exponent = -0.5f*xToU.dotprod(variance);
-    double determinantCovMatrix = determinant;
+    auto variance = invertCovarianceMatrix * xToU;
 
-    if (determinantCovMatrix < 0)
-      determinantCovMatrix = fabs(determinantCovMatrix);
+    return -0.5 * xToU.dotprod(variance) - 0.5 * std::log(fabs(determinant));
+}
 
-    double distance
-        = (1.0f / (pow(2.0f * 3.14159, pt.size() / 2.0f)
-                   * sqrt(determinantCovMatrix))) 
-        * std::exp(value_exponent);
-    
-    return distance;
+namespace {
 
-}
+// Points are processed in chunks of this size
+static constexpr int POINTS_PER_CHUNK = 1024;
 
+// Singular values (variances) below this are ignored
+static constexpr double MIN_VARIANCE = 0.0001;
 
-boost::multi_array<double, 2>
-EstimateCovariance(int i,
-                   const std::vector<distribution<double>> & points, 
-                   const  MatrixType& distanceMatrix,
-                   double totalWeight,
-                   distribution<double> average)
-{
-    boost::multi_array<double, 2> variant;
+/** What the E-step needs to know about a cluster: the linear map that takes
+    x - centroid to a space where the cluster is a unit gaussian, so that
+    the Mahalanobis distance is just the squared norm of the result.  For
+    a full covariance this is diag(1/sqrt(s)) * Q', where Q diag(s) Q' is
+    the eigendecomposition of the covariance matrix, keeping only the
+    significant values as the pseudo-inverse does.  For a diagonal
+    covariance, it's the inverse standard deviation of each dimension.
+*/
+struct ClusterFactor {
+    distribution<double> centroid;
+    std::vector<double> whitening;   ///< rank x d, row major (full)
+    int rank = 0;
+    std::vector<double> invStd;      ///< d (diagonal)
+    double logNormalizer = 0.0;      ///< -0.5 log(pseudo determinant)
+};
+
+/** Sufficient statistics for the M-step, accumulated about the centroid
+    used for the E-step for numerical stability.
+*/
+struct ClusterStats {
+    ClusterStats(int d, bool diagonal)
+        : sum(d, 0.0), sumSquares(diagonal ? d : d * d, 0.0)
+    {
+    }
 
-    if (totalWeight < 0.000001f)
-      return variant;
+    double weight = 0.0;
+    std::vector<double> sum;
+    std::vector<double> sumSquares;  ///< d x d, or d if diagonal
 
-    variant.resize(boost::extents[average.size()][average.size()]);
-    for (int n = 0; n < distanceMatrix.shape()[0]; ++n)
+    ClusterStats & operator += (const ClusterStats & other)
     {
-        distribution<double> pt = points[n] - average;
-        double distance = distanceMatrix[n][i];
-        int dim = average.size();
-        MatrixType variantPt(boost::extents[dim][dim]);
-
-	    for (unsigned i = 0;  i < dim;  ++i)
-	    {
-	        for (unsigned j = 0;  j < dim;  ++j)
-	        {
-	            variantPt[i][j] = pt[i]*pt[j] * distance;    
-	        }
-	    }
-
-        if (n == 0) {                                    
-            variant = std::move(variantPt);
+        weight += other.weight;
+        for (size_t i = 0;  i < sum.size();  ++i)
+            sum[i] += other.sum[i];
+        for (size_t i = 0;  i < sumSquares.size();  ++i)
+            sumSquares[i] += other.sumSquares[i];
+        return *this;
+    }
+};
+
+/** Calculate the inverse (or pseudo-inverse), the pseudo determinant and
+    the factor for the E-step of the cluster from its covariance matrix.
+*/
+void factorCluster(EstimationMaximisation::Cluster & cluster,
+                   ClusterFactor & factor,
+                   bool diagonal)
+{
+    int d = cluster.centroid.size();
+    auto & cov = cluster.covarianceMatrix;
+    ExcAssertEqual(cov.shape()[0], d);
+    ExcAssertEqual(cov.shape()[1], d);
+
+    double logDeterminant = 0.0;
+    factor.centroid = cluster.centroid;
+
+    if (diagonal) {
+        cluster.invertCovarianceMatrix.resize(boost::extents[d][d]);
+        std::fill(cluster.invertCovarianceMatrix.data(),
+                  cluster.invertCovarianceMatrix.data() + d * d, 0.0);
+        factor.invStd.resize(d);
+        for (int i = 0;  i < d;  ++i) {
+            double var = cov[i][i];
+            if (var < MIN_VARIANCE) {
+                factor.invStd[i] = 0.0;
+            }
+            else {
+                logDeterminant += std::log(var);
+                factor.invStd[i] = 1.0 / std::sqrt(var);
+                cluster.invertCovarianceMatrix[i][i] = 1.0 / var;
+            }
         }
-        else {
-            variant = std::move(variant + variantPt);
+    }
+    else {
+        auto svdMatrix = cov;
+        MatrixType VT,U;
+        distribution<double> svalues;
+        ML::svd_square(svdMatrix, VT, U, svalues);
+
+        //Remove small values and calculate pseudo determinant
+        auto invertSingularValues = svalues;
+        factor.whitening.clear();
+        factor.rank = 0;
+        for (int i = 0; i < svalues.size(); ++i) {
+            if (svalues[i] < MIN_VARIANCE) {
+                invertSingularValues[i] = 0.0f;
+                continue;
+            }
+
+            logDeterminant += std::log(svalues[i]);
+            invertSingularValues[i] = 1.0f / svalues[i];
+
+            // The rows of VT are the eigenvectors, as the matrix is
+            // symmetric
+            double scale = 1.0 / std::sqrt(svalues[i]);
+            for (int j = 0;  j < d;  ++j)
+                factor.whitening.push_back(VT[i][j] * scale);
+            ++factor.rank;
         }
+
+        // calculate pseudo inverse and pseudo determinant
+
+        // We dont actually need the pseudo covariant but it sould look
+        // like this
+        // MatrixType pseudoCovariant = U * diag(svalues) * VT;
+
+        cluster.invertCovarianceMatrix.resize(boost::extents[d][d]);
+        cluster.invertCovarianceMatrix
+            = transpose(VT) * diag(invertSingularValues) * transpose(U);
     }
 
-    variant = variant / totalWeight;
-    return variant;
+    cluster.pseudoDeterminant = std::exp(logDeterminant);
+    factor.logNormalizer = -0.5 * logDeterminant;
 }
 
+} // file scope
+
 void
 EstimationMaximisation::
 train(const std::vector<distribution<double>> & points,
       std::vector<int> & in_cluster,
       int nbClusters,
       int maxIterations,
-      int randomSeed) 
+      int randomSeed,
+      bool diagonalCovariance)
 {
     using namespace std;
 
@@ -119,9 +197,6 @@ train(const std::vector<distribution<double>> & points,
     in_cluster.resize(npoints, -1);
     clusters.resize(nbClusters);
 
-    boost::multi_array<double, 2> distanceMatrix
-        (boost::extents[npoints][nbClusters]);
-
     // Smart initialization of the centroids
     // Same as Kmeans at the moment
     clusters[0].centroid = points[rng() % points.size()];
@@ -143,8 +218,6 @@ train(const std::vector<distribution<double>> & points,
 
                 double dist = distance(points[randomIdx], clusters[k].centroid);
 
-                distanceMatrix[j][i] = dist;
-
                 if (dist < distMin) {
                     distMin = dist;
                 }
@@ -161,13 +234,20 @@ train(const std::vector<distribution<double>> & points,
     }
 
     int numdimensions = points[0].size();
-    for (int i=0; i < nbClusters; ++i) {
+    int d = numdimensions;
+    int k = nbClusters;
+
+    for (auto & p: points) {
+        if (p.size() != d)
+            throw MLDB::Exception("EM points must all have the same number "
+                                  "of dimensions");
+    }
 
+    std::vector<ClusterFactor> factors(k);
+
+    for (int i=0; i < nbClusters; ++i) {
         ML::setIdentity<double>(numdimensions, clusters[i].covarianceMatrix);
-        clusters[i].invertCovarianceMatrix
-            .resize(boost::extents[numdimensions][numdimensions]);
-        clusters[i].invertCovarianceMatrix = clusters[i].covarianceMatrix;
-        clusters[i].pseudoDeterminant = 1.0f; 
+        factorCluster(clusters[i], factors[i], diagonalCovariance);
     }
 
     for (int iter = 0;  iter < maxIterations;  ++iter) {
@@ -176,94 +256,174 @@ train(const std::vector<distribution<double>> & points,
         // contents are stable
         std::atomic<int> changes(0);
 
-        //Step 1: assign each point to a distribution in the mixture
-
-        auto findNewCluster = [&] (int i) {
-            
-            int best_cluster = this->assign(points[i], distanceMatrix, i);
-
-            if (best_cluster != in_cluster[i]) {
-                ++changes;
-                in_cluster[i] = best_cluster;
-            }
-        };
-
-        for (int i = 0; i < points.size(); ++i)
-            findNewCluster(i);
-
-        //Step 2: maximizing distribution's parameters 
-        for (auto & c : clusters) {
-            // If no member, we want to leave it there
-            std::fill(c.centroid.begin(), c.centroid.end(), 0.0);
-            c.totalWeight = 0.0f;
-        }
-
-        std::vector<std::mutex> locks(clusters.size());
-
-        auto addToMeanForPoint = [&] (int i) {
-
-            auto point = points[i];
-            for (int cluster = 0; cluster < clusters.size(); ++cluster) {
-                double distance = distanceMatrix[i][cluster];
-                clusters[cluster].centroid += point * distance;
-                clusters[cluster].totalWeight += distance;
-            }
-        };
-
-        // calculate mean
-        for (int i = 0; i < points.size(); ++i) {
-            addToMeanForPoint(i);
-        }
+        std::vector<ClusterStats> stats(k, ClusterStats(d, diagonalCovariance));
+        std::mutex statsLock;
+
+        /* Both steps in one pass over the points, a chunk at a time.
+           Step 1 (expectation) finds the soft assignment of each point to
+           each distribution of the mixture, and step 2 (maximization)
+           accumulates the statistics needed to estimate the new
+           parameters.  Each chunk accumulates its own statistics, which
+           are merged at the end of the chunk.
+        */
+        auto onChunk = [&] (size_t begin, size_t end)
+            {
+                int np = end - begin;
+
+                // Points of the chunk minus a centroid, one per row
+                std::vector<double> centered(np * d);
+                // Whitened points (one per column), then weighted points
+                std::vector<double> scratch(np * d);
+                // Log densities then weights, one row per point
+                std::vector<double> weights(np * k);
+
+                auto center = [&] (int c)
+                    {
+                        const double * centroid = factors[c].centroid.data();
+                        for (int p = 0;  p < np;  ++p) {
+                            const double * pt = points[begin + p].data();
+                            double * out = centered.data() + p * d;
+                            for (int j = 0;  j < d;  ++j)
+                                out[j] = pt[j] - centroid[j];
+                        }
+                    };
+
+                for (int c = 0;  c < k;  ++c) {
+                    const ClusterFactor & factor = factors[c];
+                    center(c);
+
+                    if (!diagonalCovariance && factor.rank > 0) {
+                        // scratch = whitening * centered, for all points of
+                        // the chunk at once
+                        LAPack::gemm('T', 'N', factor.rank, np, d, 1.0,
+                                     factor.whitening.data(), d,
+                                     centered.data(), d,
+                                     0.0, scratch.data(), factor.rank);
+                    }
+
+                    for (int p = 0;  p < np;  ++p) {
+                        // Squared Mahalanobis distance to the centroid
+                        double q = 0.0;
+                        if (diagonalCovariance) {
+                            const double * x = centered.data() + p * d;
+                            for (int j = 0;  j < d;  ++j) {
+                                double y = x[j] * factor.invStd[j];
+                                q += y * y;
+                            }
+                        }
+                        else {
+                            const double * y = scratch.data() + p * factor.rank;
+                            for (int j = 0;  j < factor.rank;  ++j)
+                                q += y[j] * y[j];
+                        }
+                        weights[p * k + c] = factor.logNormalizer - 0.5 * q;
+                    }
+                }
 
-        //normalizeMean
-        for (int cluster = 0; cluster < clusters.size(); ++cluster) {
-            if (clusters[cluster].totalWeight > 0.000001f)
-                {
-                    clusters[cluster].centroid
-                        = clusters[cluster].centroid
-                        / clusters[cluster].totalWeight;
+                // Normalize to get the weights, and find the most likely
+                // cluster
+                for (int p = 0;  p < np;  ++p) {
+                    double * w = weights.data() + p * k;
+                    int best_cluster = 0;
+                    for (int c = 1;  c < k;  ++c) {
+                        if (w[c] > w[best_cluster])
+                            best_cluster = c;
+                    }
+
+                    double maxLog = w[best_cluster];
+                    double total = 0.0;
+                    for (int c = 0;  c < k;  ++c) {
+                        w[c] = std::exp(w[c] - maxLog);
+                        total += w[c];
+                    }
+                    for (int c = 0;  c < k;  ++c)
+                        w[c] /= total;
+
+                    if (best_cluster != in_cluster[begin + p]) {
+                        ++changes;
+                        in_cluster[begin + p] = best_cluster;
+                    }
                 }
-        }
-	     
-        //calculate covariant matrix
-        for (int i = 0; i < clusters.size(); ++i) {
-            clusters[i].covarianceMatrix
-                = EstimateCovariance(i, points, distanceMatrix,
-                                     clusters[i].totalWeight,
-                                     clusters[i].centroid);
-            ExcAssertEqual(clusters[i].covarianceMatrix.shape()[0],
-                           clusters[i].covarianceMatrix.shape()[1]);
-
-            auto svdMatrix = clusters[i].covarianceMatrix;
-            MatrixType VT,U;
-            distribution<double> svalues;
-            ML::svd_square(svdMatrix, VT, U, svalues);
-
-            //Remove small values and calculate pseudo determinant
-            double pseudoDeterminant = 1.0f;
-            auto invertSingularValues = svalues;
-            for (int i = 0; i < svalues.size(); ++i) {
-
-                if (svalues[i] < 0.0001f) {
-                    svalues[i] = 0.0f;
-                    invertSingularValues[i] = 0.0f;
+
+                std::vector<ClusterStats> chunkStats
+                    (k, ClusterStats(d, diagonalCovariance));
+
+                for (int c = 0;  c < k;  ++c) {
+                    ClusterStats & s = chunkStats[c];
+                    center(c);
+
+                    // Scale the points by their weight
+                    for (int p = 0;  p < np;  ++p) {
+                        double w = weights[p * k + c];
+                        const double * x = centered.data() + p * d;
+                        double * out = scratch.data() + p * d;
+                        s.weight += w;
+                        for (int j = 0;  j < d;  ++j) {
+                            out[j] = w * x[j];
+                            s.sum[j] += out[j];
+                        }
+                        if (diagonalCovariance) {
+                            for (int j = 0;  j < d;  ++j)
+                                s.sumSquares[j] += out[j] * x[j];
+                        }
+                    }
+
+                    if (!diagonalCovariance) {
+                        // sumSquares = sum_p w_p x_p x_p'
+                        LAPack::gemm('N', 'T', d, d, np, 1.0,
+                                     scratch.data(), d,
+                                     centered.data(), d,
+                                     0.0, s.sumSquares.data(), d);
+                    }
                 }
-                else {
-                    pseudoDeterminant *= svalues[i];
-                    invertSingularValues[i] = 1.0f / svalues[i];
+
+                std::unique_lock<std::mutex> guard(statsLock);
+                for (int c = 0;  c < k;  ++c)
+                    stats[c] += chunkStats[c];
+            };
+
+        MLDB::parallelMapChunked(0, npoints, POINTS_PER_CHUNK, onChunk);
+
+        //Step 2: maximizing distribution's parameters
+        auto updateCluster = [&] (int c)
+            {
+                Cluster & cluster = clusters[c];
+                const ClusterStats & s = stats[c];
+
+                cluster.totalWeight = s.weight;
+
+                // If no member, we want to leave it there
+                if (s.weight <= 0.000001f)
+                    return;
+
+                // The statistics are about the old centroid; shift them to
+                // the new one
+                distribution<double> shift(d);
+                for (int j = 0;  j < d;  ++j)
+                    shift[j] = s.sum[j] / s.weight;
+
+                cluster.centroid = factors[c].centroid + shift;
+
+                //calculate covariant matrix
+                auto & cov = cluster.covarianceMatrix;
+                cov.resize(boost::extents[d][d]);
+                for (int i = 0;  i < d;  ++i) {
+                    for (int j = 0;  j < d;  ++j) {
+                        if (diagonalCovariance && i != j)
+                            cov[i][j] = 0.0;
+                        else if (diagonalCovariance)
+                            cov[i][j] = s.sumSquares[i] / s.weight
+                                - shift[i] * shift[i];
+                        else
+                            cov[i][j] = s.sumSquares[i * d + j] / s.weight
+                                - shift[i] * shift[j];
+                    }
                 }
-            }
 
-            // calculate pseudo inverse and pseudo determinant
+                factorCluster(cluster, factors[c], diagonalCovariance);
+            };
 
-            // We dont actually need the pseudo covariant but it sould look
-            // like this
-            // MatrixType pseudoCovariant = U * diag(svalues) * VT;
-            
-            clusters[i].invertCovarianceMatrix
-                = transpose(VT) * diag(invertSingularValues) * transpose(U);
-            clusters[i].pseudoDeterminant = pseudoDeterminant;
-        }
+        MLDB::parallelMap(0, k, updateCluster);
     }
 }
 
@@ -285,45 +445,33 @@ assign(const distribution<double> & point,
     if (clusters.size() == 0)
         throw MLDB::Exception("Did you train your em?");
 
-    distribution<double> distances(clusters.size());
+    distribution<double> logDensities(clusters.size());
     for (int i=0; i < clusters.size(); ++i) {
-        distances[i]
-            = gaussianDistance(point, clusters[i].centroid,
-                               clusters[i].covarianceMatrix,
-                               clusters[i].invertCovarianceMatrix,
-                               clusters[i].pseudoDeterminant);
+        logDensities[i]
+            = logGaussianDensity(point, clusters[i].centroid,
+                                 clusters[i].invertCovarianceMatrix,
+                                 clusters[i].pseudoDeterminant);
     }
 
-    double distMin = 0;
-    int best_cluster = -1;
-    double totalWeight = 0.0f;
-
-    for (int i=0; i < clusters.size(); ++i) {
-
-        double distance = distances[i];
-
-        if (pIndex >= 0) {
-            totalWeight += distance;
-            distanceMatrix[pIndex][i] = distance;
-        }	    
-        
-        if (distances[i] > distMin) {
-            distMin = distances[i];
+    int best_cluster = 0;
+    for (int i=1; i < clusters.size(); ++i) {
+        if (logDensities[i] > logDensities[best_cluster])
             best_cluster = i;
-        }
     }
 
-    if (pIndex >= 0 && totalWeight > 0) {
+    if (pIndex >= 0) {
+        double totalWeight = 0.0;
+        for (int i=0; i < clusters.size(); ++i) {
+            double weight = std::exp(logDensities[i]
+                                     - logDensities[best_cluster]);
+            distanceMatrix[pIndex][i] = weight;
+            totalWeight += weight;
+        }
         for (int i=0; i < clusters.size(); ++i) {
             distanceMatrix[pIndex][i] /= totalWeight;
         }
     }
 
-    // Most likely these are points with all distance at 0, often during the
-    // first iteration
-    if (best_cluster == -1)
-        best_cluster = 0;
-    
     return best_cluster;
 }
 
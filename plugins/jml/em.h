@@ -29,12 +29,18 @@ struct EstimationMaximisation
     std::vector<Cluster> clusters;
     std::vector<MLDB::Utf8String> columnNames;
 
+    /** Fit a mixture of nbClusters gaussians to the points.  Each
+        iteration makes a single parallel pass over the points.  With
+        diagonalCovariance, the covariance matrices are restricted to be
+        diagonal, which is much faster with many dimensions.
+    */
     void
     train(const std::vector<distribution<double>> & points,
           std::vector<int> & in_cluster,
           int nbClusters,
           int maxIterations,
-          int randomSeed); 
+          int randomSeed,
+          bool diagonalCovariance = false);
 
     int
     assign(const distribution<double> & point,
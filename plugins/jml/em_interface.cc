@@ -94,6 +94,11 @@ EMConfigDescription()
              "Maximum number of iterations to perform.  If no convergance is "
              "reached within this number of iterations, the current clustering "
              "will be returned.", 100);
+    addField("diagonalCovariance", &EMConfig::diagonalCovariance,
+             "If true, each cluster has a diagonal covariance matrix, ie its "
+             "dimensions are independent.  This is much faster to train when "
+             "there are many dimensions, and needs less data to estimate.",
+             false);
     addField("functionName", &EMConfig::functionName,
              "If specified, a function of this name will be created using "
              "the training result.");
@@ -172,7 +177,8 @@ run(const ProcedureRunConfig & run,
     int numIterations = emConfig.maxIterations;
 
     DEBUG_MSG(logger) << "EM training start";
-    em.train(vecs, inCluster, numClusters, numIterations, 0);
+    em.train(vecs, inCluster, numClusters, numIterations, 0,
+             runProcConf.diagonalCovariance);
     DEBUG_MSG(logger) << "EM training end";
 
     // Let the model know about its column names
@@ -20,6 +20,9 @@
 #include "mldb/builtin/sql_config_validator.h"
 #include "mldb/builtin/sql_expression_extractors.h"
 #include "mldb/utils/log.h"
+#include "mldb/builtin/sql_functions.h"
+#include "mldb/base/parallel.h"
+#include <mutex>
 
 using namespace std;
 
@@ -190,8 +193,31 @@ ExperimentProcedureConfigDescription()
               "test set is very large and aggregate statistics for each unique score is "
               "sufficient, for instance to generate a ROC curve. This has no effect "
               "for other values of `mode`.", false);
+    addField("foldParallelism", &ExperimentProcedureConfig::foldParallelism,
+             "Maximum number of folds that are trained and tested at the same "
+             "time.  The training and testing of each fold is itself run in "
+             "parallel, and each fold in progress holds its own training set in "
+             "memory, so it is usually best to keep this small.  A value of 1 "
+             "runs the folds one after the other.", 4);
+    addField("materializeInputData", &ExperimentProcedureConfig::materializeInputData,
+             "If true, when the folds are generated by the procedure (ie, "
+             "`datasetFolds` isn't specified) and there is more than one of "
+             "them, the `inputData` query is run only once into an in-memory "
+             "dataset that all of the folds read from.  This saves running an "
+             "expensive query once per fold, at the cost of keeping a copy of "
+             "the features in memory.", true);
     addParent<ProcedureConfig>();
 
+    std::function<void (ExperimentProcedureConfig *, JsonParsingContext &)>
+        validateFoldParallelism = [] (ExperimentProcedureConfig * config,
+                                      JsonParsingContext & context)
+        {
+            if (config->foldParallelism < 1)
+                throw AnnotatedException
+                    (400, "The classifier.experiment `foldParallelism` must "
+                     "be at least 1");
+        };
+
     onPostValidate = chain(validateQuery(&ExperimentProcedureConfig::inputData,
                                          NoGroupByHaving(),
                                          NoWhere(),
@@ -200,14 +226,15 @@ ExperimentProcedureConfigDescription()
                                          MustContainFrom(),
                                          PlainColumnSelect(),
                                          FeaturesLabelSelect()),
-                           validateQuery(&ExperimentProcedureConfig::testingDataOverride,
-                                         NoGroupByHaving(),
-                                         NoWhere(),
-                                         NoLimit(),
-                                         NoOffset(),
-                                         MustContainFrom(),
-                                         PlainColumnSelect(),
-                                         FeaturesLabelSelect()));
+                           chain(validateQuery(&ExperimentProcedureConfig::testingDataOverride,
+                                               NoGroupByHaving(),
+                                               NoWhere(),
+                                               NoLimit(),
+                                               NoOffset(),
+                                               MustContainFrom(),
+                                               PlainColumnSelect(),
+                                               FeaturesLabelSelect()),
+                                 validateFoldParallelism));
 
 }
 
@@ -301,30 +328,27 @@ ExperimentProcedure::
 run(const ProcedureRunConfig & run,
     const std::function<bool (const Json::Value &)> & onProgress) const
 {
-    JsStatsStatsGenerator statsGen;
-    JsStatsStatsGenerator statsGenTrain;
-    JsStatsStatsGenerator durationStatsGen;
-
     auto runProcConf = applyRunConfOverProcConf(procConfig, run);
 
-    std::atomic<int> progress(0);
-
-
-    auto onProgress2 = [&] (const Json::Value & details)
+    // Folds run concurrently, and the progress callback isn't necessarily
+    // thread safe
+    std::mutex progressMutex;
+    auto foldProgress = [&] (int foldNumber)
+        -> std::function<bool (const Json::Value &)>
         {
-            Json::Value value;
-            value["foldNumber"] = (int)progress;
-            value["details"] = details;
-            return onProgress(value);
+            return [&, foldNumber] (const Json::Value & details)
+                {
+                    Json::Value value;
+                    value["foldNumber"] = foldNumber;
+                    value["details"] = details;
+                    std::unique_lock<std::mutex> guard(progressMutex);
+                    return onProgress(value);
+                };
         };
 
-    vector<string> resourcesToDelete;
-
-    std::shared_ptr<Procedure> clsProcedure;
-    std::shared_ptr<Procedure> accuracyProc;
-
+    auto onProgress2 = foldProgress(0);
 
-    Json::Value test_eval_results(Json::ValueType::arrayValue);
+    vector<string> resourcesToDelete;
 
     if(!runProcConf.inputData.stm) {
         throw MLDB::Exception("Training data must be specified.");
@@ -339,6 +363,9 @@ run(const ProcedureRunConfig & run,
         throw MLDB::Exception("When using the kfold parameter, it must be >= 2.");
     }
 
+    // Folds that we generate only select rows on their rowHash()
+    bool foldsGenerated = runProcConf.datasetFolds.empty();
+
     // default behaviour if nothing is defined
     if(runProcConf.datasetFolds.size() == 0 && runProcConf.kfold == 0) {
         // if we're not using a testing dataset
@@ -374,89 +401,238 @@ run(const ProcedureRunConfig & run,
 
     ExcAssertGreater(runProcConf.datasetFolds.size(), 0);
 
-    for(auto & datasetFold : runProcConf.datasetFolds) {
-        /***
-         * TRAIN
-         * **/
-        ClassifierConfig clsProcConf;
-        clsProcConf.trainingData = runProcConf.inputData;
-        clsProcConf.trainingData.stm->where = datasetFold.trainingWhere;
-        clsProcConf.trainingData.stm->limit = datasetFold.trainingLimit;
-        clsProcConf.trainingData.stm->offset = datasetFold.trainingOffset;
-        clsProcConf.trainingData.stm->orderBy = datasetFold.trainingOrderBy;
-
-        string baseUrl = runProcConf.modelFileUrlPattern.toString();
-        MLDB::replace_all(baseUrl, "$runid",
-                        MLDB::format("%s-%d", runProcConf.experimentName, (int)progress));
-        clsProcConf.modelFileUrl = Url(baseUrl);
-        clsProcConf.configuration = runProcConf.configuration;
-        clsProcConf.configurationFile = runProcConf.configurationFile;
-        clsProcConf.algorithm = runProcConf.algorithm;
-        clsProcConf.equalizationFactor = runProcConf.equalizationFactor;
-        clsProcConf.mode = runProcConf.mode;
-        clsProcConf.multilabelStrategy = runProcConf.multilabelStrategy;        
-
-        clsProcConf.functionName = MLDB::format("%s_scorer_%d", runProcConf.experimentName, (int)progress);
-
-        if(progress == 0) {
-            PolyConfig clsProcPC;
-            clsProcPC.id = runProcConf.experimentName + "_trainer";
-            clsProcPC.type = "classifier.train";
-            clsProcPC.params = jsonEncode(clsProcConf);
-
-            INFO_MSG(logger) << " >>>>> Creating training procedure";
-            clsProcedure = createProcedure(engine, clsProcPC, onProgress2, true);
-            resourcesToDelete.push_back("/v1/procedures/"+clsProcPC.id.utf8String());
-        }
+    int numFolds = runProcConf.datasetFolds.size();
 
-        if(!clsProcedure) {
-            throw MLDB::Exception("Was unable to create classifier.train procedure");
-        }
+    /***
+     * materialize the input data
+     * with several generated folds, the input query is run once into an
+     * in-memory dataset, and the folds select their rows from it instead
+     * of each of them running it again
+     * **/
+    InputQuery foldInputData = runProcConf.inputData;
+
+    if(foldsGenerated && numFolds > 1 && runProcConf.materializeInputData) {
+        Utf8String datasetName(runProcConf.experimentName + "_inputData");
+
+        TransformDatasetConfig transformConf;
+        transformConf.inputData = runProcConf.inputData;
+        transformConf.outputDataset.id = datasetName;
+        transformConf.outputDataset.type = "tabular";
+
+        PolyConfig transformPC;
+        transformPC.id = runProcConf.experimentName + "_materializer";
+        transformPC.type = "transform";
+        transformPC.params = jsonEncode(transformConf);
+
+        INFO_MSG(logger) << " >>>>> Materializing input data";
+        auto transformProc = createProcedure(engine, transformPC, onProgress2, true);
+        resourcesToDelete.push_back("/v1/procedures/"+transformPC.id.utf8String());
+
+        ProcedureRunConfig transformRunConf;
+        transformRunConf.id = "run_0";
+        Timer timer;
+        transformProc->run(transformRunConf, onProgress2);
+        INFO_MSG(logger) << "materializing input data took " << timer.elapsed();
+
+        resourcesToDelete.push_back("/v1/datasets/"+datasetName.utf8String());
+
+        // The columns of the materialized dataset are the flattened output
+        // of the input query, so put them back into shape
+        string select = "{features.* AS *} AS features, ";
+        if (runProcConf.mode == CM_MULTILABEL)
+            select += "{label.* AS *} AS label";
+        else select += "label AS label";
+        if (extractNamedSubSelect("weight", runProcConf.inputData.stm->select))
+            select += ", weight AS weight";
+
+        foldInputData.stm = std::make_shared<SelectStatement>
+            (SelectStatement::parse(MLDB::format("SELECT %s FROM %s", select,
+                                                 PathElement(datasetName)
+                                                 .toEscapedUtf8String()
+                                                 .rawString())));
+    }
 
-        // create run configuration
-        ProcedureRunConfig clsProcRunConf;
-        clsProcRunConf.id = "run_"+to_string(progress);
-        clsProcRunConf.params = jsonEncode(clsProcConf);
-        Date trainStart = Date::now();
-        RunOutput output = clsProcedure->run(clsProcRunConf, onProgress2);
-        Date trainFinish = Date::now();
+    // Return a copy of the query restricted to one side of a fold.  Each
+    // fold needs its own, since they are modified concurrently.
+    auto foldQuery = [] (const InputQuery & query,
+                         const std::shared_ptr<SqlExpression> & where,
+                         ssize_t limit, ssize_t offset,
+                         const OrderByExpression & orderBy)
+        {
+            InputQuery result;
+            result.stm = std::make_shared<SelectStatement>(*query.stm);
+            result.stm->where = where;
+            result.stm->limit = limit;
+            result.stm->offset = offset;
+            result.stm->orderBy = orderBy;
+            return result;
+        };
 
+    auto getClassifierConfig = [&] (int foldNumber)
+        {
+            const DatasetFoldConfig & datasetFold
+                = runProcConf.datasetFolds[foldNumber];
+
+            ClassifierConfig clsProcConf;
+            clsProcConf.trainingData
+                = foldQuery(foldInputData,
+                            datasetFold.trainingWhere,
+                            datasetFold.trainingLimit,
+                            datasetFold.trainingOffset,
+                            datasetFold.trainingOrderBy);
+
+            string baseUrl = runProcConf.modelFileUrlPattern.toString();
+            MLDB::replace_all(baseUrl, "$runid",
+                              MLDB::format("%s-%d", runProcConf.experimentName, foldNumber));
+            clsProcConf.modelFileUrl = Url(baseUrl);
+            clsProcConf.configuration = runProcConf.configuration;
+            clsProcConf.configurationFile = runProcConf.configurationFile;
+            clsProcConf.algorithm = runProcConf.algorithm;
+            clsProcConf.equalizationFactor = runProcConf.equalizationFactor;
+            clsProcConf.mode = runProcConf.mode;
+            clsProcConf.multilabelStrategy = runProcConf.multilabelStrategy;
+
+            clsProcConf.functionName = MLDB::format("%s_scorer_%d", runProcConf.experimentName, foldNumber);
+
+            return clsProcConf;
+        };
 
-        /***
-         * scoring function
-         * created during the training so only add it to the cleanup list
-         * **/
+    auto getAccuracyConfig = [&] (int foldNumber, bool onTestSet)
+        {
+            const DatasetFoldConfig & datasetFold
+                = runProcConf.datasetFolds[foldNumber];
+
+            // create config for the accuracy procedure
+            AccuracyConfig accuracyConfig;
+            accuracyConfig.mode = runProcConf.mode;
+            accuracyConfig.uniqueScoresOnly = runProcConf.uniqueScoresOnly;
+            accuracyConfig.accuracyOverN = runProcConf.accuracyOverN;
+
+            if(runProcConf.outputAccuracyDataset && onTestSet) {
+                PolyConfigT<Dataset> outputPC;
+                outputPC.id = MLDB::format("%s_results_%d", runProcConf.experimentName,
+                                                          foldNumber);
+                outputPC.type = "tabular";
+                accuracyConfig.outputDataset.emplace(outputPC);
+            }
 
-        resourcesToDelete.push_back("/v1/functions/" + clsProcConf.functionName.utf8String());
+            if(onTestSet && runProcConf.testingDataOverride) {
+                accuracyConfig.testingData
+                    = foldQuery(*runProcConf.testingDataOverride,
+                                datasetFold.testingWhere,
+                                datasetFold.testingLimit,
+                                datasetFold.testingOffset,
+                                datasetFold.testingOrderBy);
+            }
+            else if(onTestSet) {
+                accuracyConfig.testingData
+                    = foldQuery(foldInputData,
+                                datasetFold.testingWhere,
+                                datasetFold.testingLimit,
+                                datasetFold.testingOffset,
+                                datasetFold.testingOrderBy);
+            }
+            else {
+                accuracyConfig.testingData
+                    = foldQuery(foldInputData,
+                                datasetFold.trainingWhere,
+                                datasetFold.trainingLimit,
+                                datasetFold.trainingOffset,
+                                datasetFold.trainingOrderBy);
+            }
 
-        /***
-         * accuracy
-         * **/
-        auto createAccuracyProcedure = [&] (AccuracyConfig & accuracyConf)
+            return accuracyConfig;
+        };
+
+    /***
+     * procedures
+     * these are created once and run with a different configuration for
+     * each fold
+     * **/
+    PolyConfig clsProcPC;
+    clsProcPC.id = runProcConf.experimentName + "_trainer";
+    clsProcPC.type = "classifier.train";
+    clsProcPC.params = jsonEncode(getClassifierConfig(0));
+
+    INFO_MSG(logger) << " >>>>> Creating training procedure";
+    std::shared_ptr<Procedure> clsProcedure
+        = createProcedure(engine, clsProcPC, onProgress2, true);
+    resourcesToDelete.push_back("/v1/procedures/"+clsProcPC.id.utf8String());
+
+    if(!clsProcedure) {
+        throw MLDB::Exception("Was unable to create classifier.train procedure");
+    }
+
+    auto createAccuracyProcedure = [&] (const Utf8String & id,
+                                        const AccuracyConfig & accuracyConf)
         {
             PolyConfig accuracyProcPC;
-            accuracyProcPC.id = runProcConf.experimentName + "_scorer";
+            accuracyProcPC.id = id;
             accuracyProcPC.type = "classifier.test";
             accuracyProcPC.params = accuracyConf;
 
             INFO_MSG(logger) << " >>>>> Creating testing procedure";
-            accuracyProc = createProcedure(engine, accuracyProcPC, onProgress2, true);
-
+            auto result = createProcedure(engine, accuracyProcPC, onProgress2, true);
             resourcesToDelete.push_back("/v1/procedures/"+accuracyProcPC.id.utf8String());
+
+            if(!result)
+                throw MLDB::Exception("Was unable to create accuracy procedure");
+            return result;
         };
 
+    std::shared_ptr<Procedure> accuracyProc
+        = createAccuracyProcedure(runProcConf.experimentName + "_scorer",
+                                  getAccuracyConfig(0, true));
+
+    // The procedure's configuration is merged into that of each run, so
+    // the evaluation on the training set needs its own, which doesn't have
+    // an output dataset
+    std::shared_ptr<Procedure> accuracyTrainProc;
+    if(runProcConf.evalTrain) {
+        accuracyTrainProc
+            = createAccuracyProcedure(runProcConf.experimentName + "_scorer_train",
+                                      getAccuracyConfig(0, false));
+    }
 
-        // setup score expression
-        string scoreExpr;
-        if     (runProcConf.mode == CM_BOOLEAN ||
-                runProcConf.mode == CM_REGRESSION)  scoreExpr = "\"%s\"({%s})[score] as score";
-        else if(runProcConf.mode == CM_CATEGORICAL ||
-                runProcConf.mode == CM_MULTILABEL) scoreExpr = "\"%s\"({%s})[scores] as score";
-        else throw MLDB::Exception("Classifier mode %d not implemented", runProcConf.mode);
+    // setup score expression
+    string scoreExpr;
+    if     (runProcConf.mode == CM_BOOLEAN ||
+            runProcConf.mode == CM_REGRESSION)  scoreExpr = "\"%s\"({%s})[score] as score";
+    else if(runProcConf.mode == CM_CATEGORICAL ||
+            runProcConf.mode == CM_MULTILABEL) scoreExpr = "\"%s\"({%s})[scores] as score";
+    else throw MLDB::Exception("Classifier mode %d not implemented", runProcConf.mode);
 
+    struct FoldOutput {
+        Json::Value foldRez;
+        Json::Value duration;
+    };
+
+    std::vector<FoldOutput> foldOutputs(numFolds);
+
+    auto runFold = [&] (size_t foldNumber)
+    {
+        auto onFoldProgress = foldProgress(foldNumber);
+
+        /***
+         * TRAIN
+         * **/
+        ClassifierConfig clsProcConf = getClassifierConfig(foldNumber);
+
+        // create run configuration
+        ProcedureRunConfig clsProcRunConf;
+        clsProcRunConf.id = "run_"+to_string(foldNumber);
+        clsProcRunConf.params = jsonEncode(clsProcConf);
+        Date trainStart = Date::now();
+        RunOutput output = clsProcedure->run(clsProcRunConf, onFoldProgress);
+        Date trainFinish = Date::now();
+
+        /***
+         * accuracy
+         * **/
 
         // this lambda actually runs the accuracy procedure for the given config
-        auto runAccuracyFor = [&] (AccuracyConfig & accuracyConf)
+        auto runAccuracyFor = [&] (const Procedure & proc,
+                                   AccuracyConfig & accuracyConf)
         {
             auto features = extractNamedSubSelect("features", accuracyConf.testingData.stm->select);
             auto label = extractNamedSubSelect("label", accuracyConf.testingData.stm->select);
@@ -472,14 +648,11 @@ run(const ProcedureRunConfig & run,
 
             Timer timer;
 
-            if(!accuracyProc)
-                throw MLDB::Exception("Was unable to create accuracy procedure");
-
             ProcedureRunConfig accuracyProcRunConf;
-            accuracyProcRunConf.id = "run_"+to_string(progress);
+            accuracyProcRunConf.id = "run_"+to_string(foldNumber);
             accuracyProcRunConf.params = jsonEncode(accuracyConf);
             Date testStart = Date::now();
-            RunOutput accuracyOutput = accuracyProc->run(accuracyProcRunConf, onProgress2);
+            RunOutput accuracyOutput = proc.run(accuracyProcRunConf, onFoldProgress);
             Date testFinish = Date::now();
 
             INFO_MSG(logger) << "accuracy took " << timer.elapsed();
@@ -488,82 +661,39 @@ run(const ProcedureRunConfig & run,
                               testFinish.secondsSinceEpoch() - testStart.secondsSinceEpoch());
         };
 
+        auto accuracyConfig = getAccuracyConfig(foldNumber, true);
 
-        auto getAccuracyConfig = [&] (bool onTestSet)
-            {
-                // create config for the accuracy procedure
-                AccuracyConfig accuracyConfig;
-                accuracyConfig.mode = runProcConf.mode;
-                accuracyConfig.uniqueScoresOnly = runProcConf.uniqueScoresOnly;
-                accuracyConfig.accuracyOverN = runProcConf.accuracyOverN;
-
-                if(runProcConf.outputAccuracyDataset && onTestSet) {
-                    PolyConfigT<Dataset> outputPC;
-                    outputPC.id = MLDB::format("%s_results_%d", runProcConf.experimentName, 
-                                                              (int)progress);
-                    outputPC.type = "tabular";
-
-                    {
-                        auto connection = InProcessRestConnection::create();
-                        RestRequest request("DELETE", "/v1/datasets/"+outputPC.id.utf8String(),
-                                            RestParams(), "{}");
-                        engine->handleRequest(*connection, request);
-                        connection->waitForResponse();
-
-                        if(connection->responseCode() != 204) {
-                            throw MLDB::Exception("HTTP error "+std::to_string(connection->responseCode())+
-                                " when trying to DELETE dataset '"+outputPC.id.utf8String()+"'");
-                        }
-                    }
-                    accuracyConfig.outputDataset.emplace(outputPC);
-                }
-
-                if(onTestSet) {
-                    accuracyConfig.testingData =
-                        runProcConf.testingDataOverride ? *runProcConf.testingDataOverride
-                                                        : runProcConf.inputData;
-                    accuracyConfig.testingData.stm->where = datasetFold.testingWhere;
-                    accuracyConfig.testingData.stm->limit = datasetFold.testingLimit;
-                    accuracyConfig.testingData.stm->offset = datasetFold.testingOffset;
-                    accuracyConfig.testingData.stm->orderBy = datasetFold.testingOrderBy;
-                }
-                else {
-                    accuracyConfig.testingData = runProcConf.inputData;
-                    accuracyConfig.testingData.stm->where = datasetFold.trainingWhere;
-                    accuracyConfig.testingData.stm->limit = datasetFold.trainingLimit;
-                    accuracyConfig.testingData.stm->offset = datasetFold.trainingOffset;
-                    accuracyConfig.testingData.stm->orderBy = datasetFold.trainingOrderBy;
-                }
-
-                return accuracyConfig;
-            };
-
-        auto accuracyConfig = getAccuracyConfig(true);
-
-        // create empty testing procedure
-        if(progress == 0)
-            createAccuracyProcedure(accuracyConfig);
+        if(accuracyConfig.outputDataset) {
+            auto connection = InProcessRestConnection::create();
+            RestRequest request("DELETE", "/v1/datasets/"+accuracyConfig.outputDataset->id.utf8String(),
+                                RestParams(), "{}");
+            engine->handleRequest(*connection, request);
+            connection->waitForResponse();
+
+            if(connection->responseCode() != 204) {
+                throw MLDB::Exception("HTTP error "+std::to_string(connection->responseCode())+
+                    " when trying to DELETE dataset '"+accuracyConfig.outputDataset->id.utf8String()+"'");
+            }
+        }
 
         // run evaluation on testing
-        auto accuracyOutput = runAccuracyFor(accuracyConfig);
+        auto accuracyOutput = runAccuracyFor(*accuracyProc, accuracyConfig);
 
         // run evaluation on training
         std::tuple<RunOutput, double> accuracyOutputTrain;
         if(runProcConf.evalTrain) {
-            auto accuracyTrainingConf = getAccuracyConfig(false);
-            createAccuracyProcedure(accuracyTrainingConf);
-            accuracyOutputTrain = runAccuracyFor(accuracyTrainingConf);
+            auto accuracyTrainingConf = getAccuracyConfig(foldNumber, false);
+            accuracyOutputTrain = runAccuracyFor(*accuracyTrainProc, accuracyTrainingConf);
         }
 
         Json::Value duration;
         duration["train"] = trainFinish.secondsSinceEpoch() - trainStart.secondsSinceEpoch();
         duration["test"] = get<1>(accuracyOutput) + (runProcConf.evalTrain ? get<1>(accuracyOutputTrain)
                                                                            : 0);
-        durationStatsGen.accumStats(duration, "");
 
         // Add results
         Json::Value foldRez;
-        foldRez["fold"] = jsonEncode(datasetFold);
+        foldRez["fold"] = jsonEncode(runProcConf.datasetFolds[foldNumber]);
         foldRez["modelFileUrl"] = clsProcConf.modelFileUrl.toUtf8String();
         foldRez["functionName"] = clsProcConf.functionName;
 
@@ -572,16 +702,40 @@ run(const ProcedureRunConfig & run,
 
         foldRez["resultsTest"] = jsonEncode(get<0>(accuracyOutput).results);
         foldRez["durationSecs"] = duration;
-        statsGen.accumStats(foldRez["resultsTest"], "");
 
         if(runProcConf.evalTrain) {
             foldRez["resultsTrain"] = jsonEncode(get<0>(accuracyOutputTrain).results);
-            statsGenTrain.accumStats(foldRez["resultsTrain"], "");
         }
 
-        test_eval_results.append(foldRez);
+        foldOutputs[foldNumber] = { std::move(foldRez), std::move(duration) };
+    };
+
+    // Each fold's training and testing is itself parallel, so only a few
+    // folds are run at once to keep the number of training sets in memory
+    // bounded
+    parallelMap(0, numFolds, runFold, runProcConf.foldParallelism);
+
+    /***
+     * scoring functions
+     * created during the training so only add them to the cleanup list
+     * **/
+    for (int i = 0;  i < numFolds;  ++i) {
+        resourcesToDelete.push_back("/v1/functions/"
+                                    + foldOutputs[i].foldRez["functionName"].asString());
+    }
+
+    JsStatsStatsGenerator statsGen;
+    JsStatsStatsGenerator statsGenTrain;
+    JsStatsStatsGenerator durationStatsGen;
+
+    Json::Value test_eval_results(Json::ValueType::arrayValue);
 
-        progress ++;
+    for (auto & foldOutput: foldOutputs) {
+        durationStatsGen.accumStats(foldOutput.duration, "");
+        statsGen.accumStats(foldOutput.foldRez["resultsTest"], "");
+        if(runProcConf.evalTrain)
+            statsGenTrain.accumStats(foldOutput.foldRez["resultsTrain"], "");
+        test_eval_results.append(foldOutput.foldRez);
     }
 
     /***
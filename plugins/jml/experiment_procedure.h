@@ -101,6 +101,12 @@ struct ExperimentProcedureConfig : public ProcedureConfig {
     bool outputAccuracyDataset = true;
     bool uniqueScoresOnly = false;
     bool evalTrain = false;
+
+    /// Maximum number of folds to run at once
+    int foldParallelism = 4;
+
+    /// Run the input query once for all generated folds
+    bool materializeInputData = true;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ExperimentProcedureConfig);
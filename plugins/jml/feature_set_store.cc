@@ -0,0 +1,88 @@
+/** feature_set_store.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Packed storage for the feature sets of a training set.
+*/
+
+#include "feature_set_store.h"
+#include "mldb/block/file_serializer.h"
+#include "mldb/engine/query_spill.h"
+#include "mldb/base/exc_assert.h"
+#include <atomic>
+#include <algorithm>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* STORED FEATURE SET                                                        */
+/*****************************************************************************/
+
+StoredFeatureSet *
+StoredFeatureSet::
+make_copy() const
+{
+    return new StoredFeatureSet(*this);
+}
+
+
+/*****************************************************************************/
+/* FEATURE SET STORE                                                         */
+/*****************************************************************************/
+
+FeatureSetStore::
+FeatureSetStore(std::shared_ptr<MappedSerializer> serializer,
+                size_t entriesPerChunk)
+    : serializer(std::move(serializer)),
+      entriesPerChunk(entriesPerChunk),
+      chunkUsed(0), bytesUsed_(0)
+{
+    ExcAssert(this->serializer);
+    ExcAssertGreater(entriesPerChunk, 0);
+}
+
+StoredFeatureSet
+FeatureSetStore::
+add(const ML::Feature_Set & features)
+{
+    size_t n = features.size();
+    if (n == 0)
+        return StoredFeatureSet();
+
+    if (chunks.empty() || chunkUsed + n > chunks.back().length()) {
+        chunks.emplace_back(serializer->allocateWritableT<Entry>
+                            (std::max(n, entriesPerChunk)));
+        chunkUsed = 0;
+    }
+
+    Entry * entries = chunks.back().data() + chunkUsed;
+    std::copy(features.begin(), features.end(), entries);
+    chunkUsed += n;
+    bytesUsed_ += n * sizeof(Entry);
+
+    return StoredFeatureSet(entries, n);
+}
+
+static std::atomic<uint64_t> spillFileNumber(0);
+
+std::shared_ptr<MappedSerializer>
+createFeatureSetSpillFile()
+{
+    Utf8String filename
+        = getQuerySpillDirectory() + "/mldb-training-data-"
+        + to_string(getpid()) + "-" + to_string(spillFileNumber++);
+    auto result = std::make_shared<FileSerializer>(filename);
+
+    // The file stays open, so it can be removed from the directory straight
+    // away and its space will be returned once it's closed.
+    ::unlink(filename.rawData());
+
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,100 @@
+/** feature_set_store.h                                            -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Packed storage for the feature sets of a training set.
+*/
+
+#pragma once
+
+#include "mldb/plugins/jml/jml/feature_set.h"
+#include "mldb/block/memory_region.h"
+#include <memory>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* STORED FEATURE SET                                                        */
+/*****************************************************************************/
+
+/** A feature set whose (sorted) entries live in a FeatureSetStore.  It
+    doesn't own them; the store must outlive it.
+*/
+
+struct StoredFeatureSet: public ML::Feature_Set {
+    typedef std::pair<ML::Feature, float> Entry;
+
+    StoredFeatureSet(Entry * entries = nullptr, size_t numEntries = 0)
+        : entries(entries), numEntries(numEntries)
+    {
+    }
+
+    virtual std::tuple<const ML::Feature *, const float *, int, int, size_t>
+    get_data(bool need_sorted = false) const
+    {
+        return std::make_tuple(&entries[0].first, &entries[0].second,
+                               sizeof(Entry), sizeof(Entry), numEntries);
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    /// Always sorted
+    virtual void sort()
+    {
+    }
+
+    virtual StoredFeatureSet * make_copy() const;
+
+    Entry * entries;
+    size_t numEntries;
+};
+
+
+/*****************************************************************************/
+/* FEATURE SET STORE                                                         */
+/*****************************************************************************/
+
+/** Append-only storage for the feature sets of a training set.  Instead of
+    each row being its own vector (with its own allocation and spare
+    capacity), the entries of the rows are packed end to end into large
+    chunks allocated from a MappedSerializer.  With a FileSerializer the
+    chunks are backed by a file, so that they can be paged out when the
+    training set doesn't fit in memory.
+
+    Not thread safe; use one per thread.  Many stores can share the same
+    serializer.
+*/
+
+struct FeatureSetStore {
+    typedef StoredFeatureSet::Entry Entry;
+
+    FeatureSetStore(std::shared_ptr<MappedSerializer> serializer,
+                    size_t entriesPerChunk = 1 << 20);
+
+    /** Copy the entries of the given feature set into the store, and
+        return a feature set referring to them. */
+    StoredFeatureSet add(const ML::Feature_Set & features);
+
+    /// Number of bytes used by the stored entries
+    size_t bytesUsed() const { return bytesUsed_; }
+
+private:
+    std::shared_ptr<MappedSerializer> serializer;
+    size_t entriesPerChunk;
+    std::vector<MutableMemoryRegionT<Entry> > chunks;
+    size_t chunkUsed;
+    size_t bytesUsed_;
+};
+
+/** Create a serializer that holds the stored feature sets in a temporary
+    file in the query spill directory, rather than in memory.  The file is
+    removed once it's no longer used.
+*/
+std::shared_ptr<MappedSerializer> createFeatureSetSpillFile();
+
+} // namespace MLDB
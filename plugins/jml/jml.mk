@@ -51,13 +51,15 @@ LIBMLDB_JML_PLUGIN_SOURCES:= \
 	experiment_procedure.cc \
 	randomforest.cc \
 	dataset_feature_space.cc \
+	feature_set_store.cc \
 	kmeans_interface.cc \
 	em_interface.cc \
 	tsne_interface.cc \
 
 
 LIBMLDB_JML_PLUGIN_LINK:= \
-	ml
+	ml \
+	$(if $(findstring 1,$(CUDA_ENABLED)),boosting_cuda)
 
 $(eval $(call library,mldb_jml_plugin,$(LIBMLDB_JML_PLUGIN_SOURCES),$(LIBMLDB_JML_PLUGIN_LINK)))
 
@@ -169,28 +169,7 @@ predict(const Feature_Set & features,
     //result.normalize();
     //result -= 0.5;
 
-    double total = 0.0;
-
-    if (output == LOGIT || output == LOGIT_NORM) {
-        for (unsigned i = 0;  i < result.size();  ++i) {
-            /* Avoid an overflow from the exp. */
-            if (result[i] > fp_traits<float>::max_exp_arg * 0.9)
-                result[i] = fp_traits<float>::max_exp_arg * 0.9;
-            double e = exp(result[i]);
-            double x = e / (e + (1.0 / e));
-            total += x;
-            result[i] = x;
-        }
-        if (output == LOGIT_NORM) {
-            if ((float)total == 0.0F) {
-                cerr << "warning: boosted stumps says no results are correct"
-                     << endl;
-                result.fill(1);  // assign all elements
-                result.normalize();
-            }
-            else result /= total;
-        }
-    }
+    double total = transform_output(result);
 
     for (unsigned i = 0;  i < result.size();  ++i) {
         if (!finite(result[i])) {
@@ -251,11 +230,171 @@ predict(int label, const Feature_Set & features,
     return result;
 }
 
+double
+Boosted_Stumps::
+transform_output(distribution<float> & result) const
+{
+    double total = 0.0;
+
+    if (output == LOGIT || output == LOGIT_NORM) {
+        for (unsigned i = 0;  i < result.size();  ++i) {
+            /* Avoid an overflow from the exp. */
+            if (result[i] > fp_traits<float>::max_exp_arg * 0.9)
+                result[i] = fp_traits<float>::max_exp_arg * 0.9;
+            double e = exp(result[i]);
+            double x = e / (e + (1.0 / e));
+            total += x;
+            result[i] = x;
+        }
+        if (output == LOGIT_NORM) {
+            if ((float)total == 0.0F) {
+                cerr << "warning: boosted stumps says no results are correct"
+                     << endl;
+                result.fill(1);  // assign all elements
+                result.normalize();
+            }
+            else result /= total;
+        }
+    }
+
+    return total;
+}
+
+bool
+Boosted_Stumps::
+optimization_supported() const
+{
+    return true;
+}
+
+bool
+Boosted_Stumps::
+predict_is_optimized() const
+{
+    return optimized_;
+}
+
+bool
+Boosted_Stumps::
+optimize_impl(Optimization_Info & info)
+{
+    int nl = label_count();
+
+    optimized_stumps_.clear();
+    optimized_preds_.clear();
+    optimized_stumps_.reserve(stumps.size());
+    optimized_preds_.reserve(stumps.size() * 3 * nl);
+
+    auto addPred = [&] (const Label_Dist & pred)
+        {
+            size_t n = std::min<size_t>(pred.size(), nl);
+            optimized_preds_.insert(optimized_preds_.end(),
+                                    pred.begin(), pred.begin() + n);
+            optimized_preds_.resize(optimized_preds_.size() + nl - n, 0.0f);
+        };
+
+    for (auto & s: stumps) {
+        const Split & split = s.first;
+        const Stump & stump = s.second;
+
+        if (split.op() > Split::NOT_MISSING)
+            throw Exception("Boosted_Stumps::optimize(): invalid split op");
+
+        Optimized_Stump optimized;
+        optimized.split_val = split.split_val();
+        optimized.feature = info.get_optimized_index(split.feature());
+        optimized.op = split.op();
+        optimized_stumps_.push_back(optimized);
+
+        // In the order of the branches
+        addPred(stump.action.pred_false);
+        addPred(stump.action.pred_true);
+        addPred(stump.action.pred_missing);
+    }
+
+    return optimized_ = true;
+}
+
+Label_Dist
+Boosted_Stumps::
+optimized_predict_impl(const float * features,
+                       const Optimization_Info & info,
+                       PredictionContext * context) const
+{
+    if (!optimized_)
+        return Classifier_Impl::optimized_predict_impl(features, info, context);
+
+    int nl = label_count();
+    distribution<float> result(nl);
+    if (bias.size()) result += bias;
+
+    // Same order of accumulation as predict_core(), so that the results
+    // are identical
+    for (unsigned i = 0;  i < optimized_stumps_.size();  ++i) {
+        const Optimized_Stump & stump = optimized_stumps_[i];
+        int branch = Flat_Tree::branch(stump.split_val, stump.op,
+                                       features[stump.feature]);
+        const float * pred = &optimized_preds_[(i * 3 + branch) * nl];
+        for (unsigned j = 0;  j < nl;  ++j)
+            result[j] += pred[j];
+    }
+
+    transform_output(result);
+
+    for (unsigned i = 0;  i < result.size();  ++i) {
+        if (!finite(result[i]))
+            throw Exception("Boosted_Stumps::predict(): non-finite result");
+    }
+
+    return result;
+}
+
+float
+Boosted_Stumps::
+optimized_predict_impl(int label,
+                       const float * features,
+                       const Optimization_Info & info,
+                       PredictionContext * context) const
+{
+    if (!optimized_)
+        return Classifier_Impl::optimized_predict_impl(label, features, info,
+                                                       context);
+
+    if (output == LOGIT_NORM) {
+        /* Need to predict all, so we know how to normalize. */
+        return optimized_predict_impl(features, info, context)[label];
+    }
+
+    int nl = label_count();
+    if (label < 0 || label >= nl)
+        throw Exception(format("Boosted_Stumps::predict(int, float *): "
+                               "Attempt to predict label %d with label_count "
+                               " %d", label, nl));
+
+    float result = 0.0;
+    if (bias.size()) result += bias[label];
+
+    for (unsigned i = 0;  i < optimized_stumps_.size();  ++i) {
+        const Optimized_Stump & stump = optimized_stumps_[i];
+        int branch = Flat_Tree::branch(stump.split_val, stump.op,
+                                       features[stump.feature]);
+        result += optimized_preds_[(i * 3 + branch) * nl + label];
+    }
+
+    if (output == LOGIT) {
+        double e = exp(result);
+        result = e / (e + 1.0 / e);
+    }
+    return result;
+}
+
 Boosted_Stumps::iterator Boosted_Stumps::
 insert(const Stump & stump, float weight)
 {
     if (stump.split.feature() == MISSING_FEATURE) return end();
 
+    optimized_ = false;
+
     iterator it = find(stump.split);
     if (it == end())
         return iterator
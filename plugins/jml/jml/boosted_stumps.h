@@ -11,6 +11,7 @@
 
 #include "mldb/plugins/jml/jml/classifier.h"
 #include "stump.h"
+#include "flat_tree.h"
 #include "plugins/jml/enum_info.h"
 #include "mldb/utils/floating_point.h"
 #include <boost/iterator/transform_iterator.hpp>
@@ -119,6 +120,9 @@ public:
         bias.swap(other.bias);
         sum_missing.swap(other.sum_missing);
         std::swap(predicted_, other.predicted_);
+        std::swap(optimized_, other.optimized_);
+        optimized_stumps_.swap(other.optimized_stumps_);
+        optimized_preds_.swap(other.optimized_preds_);
     }
 
     using Classifier_Impl::predict;
@@ -162,6 +166,27 @@ public:
     void predict_core(const Feature_Set & features, const Results & results)
         const;
 
+    virtual bool optimization_supported() const;
+
+    virtual bool predict_is_optimized() const;
+
+    /** Lays the stumps out in flat arrays, in the same order as the stumps
+        map, with the index of their feature in the dense vector.  Inserting
+        a stump undoes the optimization. */
+    virtual bool
+    optimize_impl(Optimization_Info & info);
+
+    virtual Label_Dist
+    optimized_predict_impl(const float * features,
+                           const Optimization_Info & info,
+                           PredictionContext * context = 0) const;
+
+    virtual float
+    optimized_predict_impl(int label,
+                           const float * features,
+                           const Optimization_Info & info,
+                           PredictionContext * context = 0) const;
+
     /** Calculate the accuracy.  This can be done much quicker with the
         boosted stumps as it only needs to look at the index for the features
         that it has learned a stump for, and these are nicely indexed
@@ -260,6 +285,25 @@ public:
                                 PredictionContext * context = 0) const;
     
 private:
+    /** Apply the output transformation to the raw scores in result.
+        Returns the total of the logistic function outputs (which is used
+        to normalize them for LOGIT_NORM), or zero for RAW. */
+    double transform_output(distribution<float> & result) const;
+
+    /** Split of a stump, compiled for optimized predict. */
+    struct Optimized_Stump {
+        float split_val;
+        uint32_t feature;   ///< Index of feature in the dense vector
+        uint32_t op;        ///< Split::Op to apply
+    };
+
+    bool optimized_ = false;
+    std::vector<Optimized_Stump> optimized_stumps_;
+
+    /// label_count() predictions for each of the false, true and MISSING
+    /// branches of each optimized stump
+    std::vector<float> optimized_preds_;
+
     /** For reconstituting old classifiers only */
     Boosted_Stumps(const std::shared_ptr<const Feature_Space>
                        & feature_space,
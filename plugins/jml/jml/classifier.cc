@@ -543,6 +543,69 @@ predict(int label,
     return optimized_predict_impl(label, fv, info, context);
 }
 
+void
+Classifier_Impl::
+predict_batch(const float * features,
+              size_t num_examples,
+              const Optimization_Info & info,
+              float * output) const
+{
+    size_t nf = info.features_in();
+    size_t nl = label_count();
+
+    if (!predict_is_optimized() || !info) {
+        for (size_t i = 0;  i < num_examples;  ++i) {
+            Label_Dist dist = predict(features + i * nf, info);
+            ExcAssertEqual(dist.size(), nl);
+            std::copy(dist.begin(), dist.end(), output + i * nl);
+        }
+        return;
+    }
+
+    // Map and predict the examples a block at a time, so that the mapped
+    // features stay in cache while all of the model is applied to them
+    enum { BLOCK = 256 };
+    size_t nfo = info.features_out();
+    std::vector<float> mapped(BLOCK * nfo);
+    std::vector<double> accum(BLOCK * nl);
+
+    for (size_t start = 0;  start < num_examples;  start += BLOCK) {
+        size_t n = std::min<size_t>(BLOCK, num_examples - start);
+        for (size_t i = 0;  i < n;  ++i)
+            info.apply(features + (start + i) * nf, &mapped[i * nfo]);
+
+        std::fill(accum.begin(), accum.begin() + n * nl, 0.0);
+        optimized_predict_batch_impl(mapped.data(), n, info, accum.data());
+        std::copy(accum.begin(), accum.begin() + n * nl,
+                  output + start * nl);
+    }
+}
+
+void
+Classifier_Impl::
+predict_batch(int label,
+              const float * features,
+              size_t num_examples,
+              const Optimization_Info & info,
+              float * output) const
+{
+    size_t nf = info.features_in();
+
+    if (!predict_is_optimized() || !info) {
+        for (size_t i = 0;  i < num_examples;  ++i)
+            output[i] = predict(label, features + i * nf, info);
+        return;
+    }
+
+    // Map the features of all examples with the same buffer
+    float fv[info.features_out()];
+
+    for (size_t i = 0;  i < num_examples;  ++i) {
+        info.apply(features + i * nf, fv);
+        output[i] = optimized_predict_impl(label, fv, info);
+    }
+}
+
 bool
 Classifier_Impl::
 optimize_impl(Optimization_Info & info)
@@ -580,6 +643,22 @@ optimized_predict_impl(const float * features,
     }
 }
 
+void
+Classifier_Impl::
+optimized_predict_batch_impl(const float * features,
+                             size_t num_examples,
+                             const Optimization_Info & info,
+                             double * accum,
+                             double weight) const
+{
+    size_t nfo = info.features_out();
+    size_t nl = label_count();
+
+    for (size_t i = 0;  i < num_examples;  ++i)
+        optimized_predict_impl(features + i * nfo, info, accum + i * nl,
+                               weight);
+}
+
 float
 Classifier_Impl::
 optimized_predict_impl(int label,
@@ -359,6 +359,26 @@ public:
                           const Optimization_Info & info,
                           PredictionContext * context = 0) const;
 
+    /** Optimized predict for a batch of dense feature vectors, stored one
+        after the other with info.features_in() features each.  The output
+        has label_count() entries per example.  The default calls the
+        optimized predict for each example; classifiers that can share work
+        over a batch should override it.
+    */
+    virtual void predict_batch(const float * features,
+                               size_t num_examples,
+                               const Optimization_Info & info,
+                               float * output) const;
+
+    /** As above, but for the given label only, with one output entry per
+        example.
+    */
+    virtual void predict_batch(int label,
+                               const float * features,
+                               size_t num_examples,
+                               const Optimization_Info & info,
+                               float * output) const;
+
     //protected:
 
     /** Function to override to perform the optimization.  Default will
@@ -390,6 +410,19 @@ public:
                            const float * features,
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
+
+    /** Optimized predict for a batch of dense feature vectors that have
+        already been mapped with info.apply(), stored one after the other
+        with info.features_out() features each.  Adds weight times the
+        prediction for each example to its label_count() entries of accum.
+        The default calls optimized_predict_impl() for each example.
+    */
+    virtual void
+    optimized_predict_batch_impl(const float * features,
+                                 size_t num_examples,
+                                 const Optimization_Info & info,
+                                 double * accum,
+                                 double weight = 1.0) const;
     
 public:
     /** Run the classifier over the entire dataset, calling the predict
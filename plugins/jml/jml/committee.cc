@@ -179,6 +179,28 @@ optimized_predict_impl(int label,
     return result;
 }
 
+void
+Committee::
+optimized_predict_batch_impl(const float * features,
+                             size_t num_examples,
+                             const Optimization_Info & info,
+                             double * accum,
+                             double weight) const
+{
+    int nl = bias.size();
+
+    for (size_t i = 0;  i < num_examples;  ++i)
+        for (unsigned j = 0;  j < nl;  ++j)
+            accum[i * nl + j] += weight * bias[j];
+
+    for (unsigned i = 0;  i < classifiers.size();  ++i) {
+        if (weights[i] == 0.0) continue;
+        classifiers[i]
+            ->optimized_predict_batch_impl(features, num_examples, info,
+                                           accum, weight * weights[i]);
+    }
+}
+
 Explanation
 Committee::
 explain(const Feature_Set & feature_set,
@@ -103,6 +103,16 @@ public:
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
 
+    /** Applies each member to the whole batch in turn, so that each one's
+        model is brought into cache once per batch rather than once per
+        example. */
+    virtual void
+    optimized_predict_batch_impl(const float * features,
+                                 size_t num_examples,
+                                 const Optimization_Info & info,
+                                 double * accum,
+                                 double weight = 1.0) const;
+
     virtual Explanation explain(const Feature_Set & feature_set,
                                 const ML::Label & label,
                                 double weight = 1.0,
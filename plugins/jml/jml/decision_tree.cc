@@ -66,6 +66,7 @@ swap(Decision_Tree & other)
     std::swap(tree, other.tree);
     std::swap(encoding, other.encoding);
     std::swap(optimized_, other.optimized_);
+    std::swap(flat_, other.flat_);
 }
 
 namespace {
@@ -84,46 +85,6 @@ struct StandardGetFeatures {
     }
 };
 
-struct OptimizedGetFeatures {
-    OptimizedGetFeatures(const float * features)
-        : features(features)
-    {
-    }
-
-    const float * features;
-
-    MLDB_ALWAYS_INLINE Split::Weights operator () (const Split & split) const
-    {
-        return split.apply(features);
-    }
-                      
-};
-
-struct AccumResults {
-    explicit AccumResults(double * accum, int nl, double weight)
-        : accum(accum), nl(nl), weight(weight)
-    {
-    }
-
-    double * accum;
-    int nl;
-    double weight;
-
-    MLDB_ALWAYS_INLINE
-    void operator () (const Label_Dist & dist, float weight1)
-    {
-        if (MLDB_LIKELY(nl == 2)) {
-            double factor = weight1 * weight;
-            accum[0] += dist[0] * factor;
-            accum[1] += dist[1] * factor;
-            return;
-        }
-
-        for (unsigned i = 0;  i < nl;  ++i)
-            accum[i] += dist[i] * weight1 * weight;
-    }
-};
-
 struct DistResults {
     explicit DistResults(double * accum, int nl)
         : accum(accum), nl(nl)
@@ -209,6 +170,7 @@ Decision_Tree::
 optimize_impl(Optimization_Info & info)
 {
     optimize_recursive(info, tree.root);
+    flat_.compile(tree.root, label_count(), info);
     optimized_ = true;
     return true;
 }
@@ -235,14 +197,11 @@ optimized_predict_impl(const float * features,
                        const Optimization_Info & info,
                        PredictionContext * context) const
 {
-    OptimizedGetFeatures get_features(features);
-
-    int nl = label_count();
-    double accum[nl];
-    DistResults results(accum, nl);
+    if (flat_.empty())
+        return Classifier_Impl::optimized_predict_impl(features, info, context);
 
-    predict_recursive_impl(get_features, results, tree.root);
-    return results;
+    const float * leaf = flat_.predict(features);
+    return Label_Dist(leaf, leaf + flat_.nl);
 }
 
 void
@@ -253,10 +212,15 @@ optimized_predict_impl(const float * features,
                        double weight,
                        PredictionContext * context) const
 {
-    OptimizedGetFeatures get_features(features);
-    AccumResults results(accum, label_count(), weight);
+    if (flat_.empty()) {
+        Classifier_Impl::optimized_predict_impl(features, info, accum, weight,
+                                                context);
+        return;
+    }
 
-    predict_recursive_impl(get_features, results, tree.root);
+    const float * leaf = flat_.predict(features);
+    for (int i = 0;  i < flat_.nl;  ++i)
+        accum[i] += leaf[i] * weight;
 }
 
 float
@@ -266,11 +230,29 @@ optimized_predict_impl(int label,
                        const Optimization_Info & info,
                        PredictionContext * context) const
 {
-    OptimizedGetFeatures get_features(features);
-    LabelResults results(label);
+    if (flat_.empty())
+        return Classifier_Impl::optimized_predict_impl(label, features, info,
+                                                       context);
 
-    predict_recursive_impl(get_features, results, tree.root);
-    return results;
+    return flat_.predict(features)[label];
+}
+
+void
+Decision_Tree::
+optimized_predict_batch_impl(const float * features,
+                             size_t num_examples,
+                             const Optimization_Info & info,
+                             double * accum,
+                             double weight) const
+{
+    if (flat_.empty()) {
+        Classifier_Impl::optimized_predict_batch_impl(features, num_examples,
+                                                      info, accum, weight);
+        return;
+    }
+
+    flat_.accumulate(features, info.features_out(), num_examples,
+                     accum, weight);
 }
 
 template<class GetFeatures, class Results>
@@ -649,6 +631,7 @@ reconstitute(DB::Store_Reader & store,
         throw Exception("Decision_Tree::reconstitute: read bad marker at end");
 
     optimized_ = false;
+    flat_.clear();
 }
     
 std::string
@@ -12,6 +12,7 @@
 #include "feature_set.h"
 #include <boost/pool/object_pool.hpp>
 #include "tree.h"
+#include "flat_tree.h"
 #include "boolean_expression.h"
 
 
@@ -54,6 +55,7 @@ public:
     Tree tree;                 ///< The tree we have learned
     Output_Encoding encoding;  ///< How the outputs are represented
     bool optimized_;           ///< Is predict() optimized?
+    Flat_Tree flat_;           ///< Tree compiled for optimized predict
 
     using Classifier_Impl::predict;
 
@@ -104,6 +106,13 @@ public:
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
 
+    virtual void
+    optimized_predict_batch_impl(const float * features,
+                                 size_t num_examples,
+                                 const Optimization_Info & info,
+                                 double * accum,
+                                 double weight = 1.0) const;
+
     template<class GetFeatures, class Results>
     void predict_recursive_impl(const GetFeatures & get_features,
                                 Results & results,
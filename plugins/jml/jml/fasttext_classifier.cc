@@ -8,10 +8,15 @@
 #include <boost/progress.hpp>
 #include <boost/timer.hpp>
 #include <functional>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
 #include "mldb/utils/vector_utils.h"
 #include "mldb/plugins/jml/jml/registry.h"
 
 #include "mldb/base/exc_assert.h"
+#include "mldb/base/parallel.h"
 #include "mldb/utils/smart_ptr_utils.h"
 
 #include "mldb/ext/fasttext/src/fasttext.h"
@@ -26,7 +31,174 @@ namespace ML {
 
 
 /*****************************************************************************/
-/* DECISION_TREE                                                             */
+/* FASTTEXT_QUANTIZED_MATRIX                                                 */
+/*****************************************************************************/
+
+void
+FastText_Quantized_Matrix::
+train(const float * data, int rows, int cols, int subDims, int iterations)
+{
+    ExcAssertGreater(subDims, 0);
+
+    this->rows = rows;
+    this->cols = cols;
+    this->subDims = subDims;
+    this->centroidCount = std::min(rows, 256);
+
+    int nsub = subvectorCount();
+    centroids.assign((size_t)nsub * centroidCount * subDims, 0.0f);
+    codes.assign((size_t)rows * nsub, 0);
+
+    if (rows == 0)
+        return;
+
+    // The centroids are learned on a sample of at most this many rows
+    static constexpr int MAX_TRAINING_ROWS = 256 * 256;
+
+    auto onSubvector = [&] (size_t s)
+        {
+            int first = s * subDims;
+            int dims = std::min(subDims, cols - first);
+            float * c = centroids.data() + s * centroidCount * subDims;
+
+            auto dist = [&] (int row, const float * centroid)
+                {
+                    const float * x = data + (size_t)row * cols + first;
+                    float result = 0.0f;
+                    for (int d = 0;  d < dims;  ++d)
+                        result += (x[d] - centroid[d]) * (x[d] - centroid[d]);
+                    return result;
+                };
+
+            auto nearest = [&] (int row)
+                {
+                    int best = 0;
+                    float bestDist = INFINITY;
+                    for (int k = 0;  k < centroidCount;  ++k) {
+                        float d = dist(row, c + k * subDims);
+                        if (d < bestDist) {
+                            best = k;
+                            bestDist = d;
+                        }
+                    }
+                    return best;
+                };
+
+            std::mt19937 rng(s + 1);
+            std::vector<int> sample(rows);
+            std::iota(sample.begin(), sample.end(), 0);
+            std::shuffle(sample.begin(), sample.end(), rng);
+            if (sample.size() > MAX_TRAINING_ROWS)
+                sample.resize(MAX_TRAINING_ROWS);
+
+            // Start from distinct rows of the sample
+            for (int k = 0;  k < centroidCount;  ++k) {
+                const float * x = data + (size_t)sample[k] * cols + first;
+                std::copy(x, x + dims, c + k * subDims);
+            }
+
+            std::vector<int> assignments(sample.size());
+            std::vector<int> counts(centroidCount);
+
+            for (int iter = 0;  iter < iterations;  ++iter) {
+                for (size_t i = 0;  i < sample.size();  ++i)
+                    assignments[i] = nearest(sample[i]);
+
+                std::fill(c, c + centroidCount * subDims, 0.0f);
+                std::fill(counts.begin(), counts.end(), 0);
+                for (size_t i = 0;  i < sample.size();  ++i) {
+                    const float * x = data + (size_t)sample[i] * cols + first;
+                    float * centroid = c + assignments[i] * subDims;
+                    for (int d = 0;  d < dims;  ++d)
+                        centroid[d] += x[d];
+                    counts[assignments[i]] += 1;
+                }
+
+                std::uniform_int_distribution<int> pick(0, sample.size() - 1);
+                for (int k = 0;  k < centroidCount;  ++k) {
+                    float * centroid = c + k * subDims;
+                    if (counts[k] == 0) {
+                        // Empty cluster; restart it on a random point
+                        const float * x
+                            = data + (size_t)sample[pick(rng)] * cols + first;
+                        std::copy(x, x + dims, centroid);
+                        continue;
+                    }
+                    for (int d = 0;  d < dims;  ++d)
+                        centroid[d] /= counts[k];
+                }
+            }
+
+            for (int row = 0;  row < rows;  ++row)
+                codes[(size_t)row * nsub + s] = nearest(row);
+        };
+
+    MLDB::parallelMap(0, nsub, onSubvector);
+}
+
+void
+FastText_Quantized_Matrix::
+addRow(float * out, int row, float scale) const
+{
+    int nsub = subvectorCount();
+    const uint8_t * rowCodes = codes.data() + (size_t)row * nsub;
+    for (int s = 0;  s < nsub;  ++s) {
+        int first = s * subDims;
+        int dims = std::min(subDims, cols - first);
+        const float * centroid
+            = centroids.data() + (s * centroidCount + rowCodes[s]) * subDims;
+        for (int d = 0;  d < dims;  ++d)
+            out[first + d] += scale * centroid[d];
+    }
+}
+
+size_t
+FastText_Quantized_Matrix::
+memusage() const
+{
+    return sizeof(*this) + centroids.capacity() * sizeof(float)
+        + codes.capacity();
+}
+
+void
+FastText_Quantized_Matrix::
+serialize(DB::Store_Writer & store) const
+{
+    store << compact_size_t(rows) << compact_size_t(cols)
+          << compact_size_t(subDims) << compact_size_t(centroidCount);
+    for (float c: centroids)
+        store << c;
+    store.save_binary(codes.data(), codes.size());
+}
+
+void
+FastText_Quantized_Matrix::
+reconstitute(DB::Store_Reader & store)
+{
+    compact_size_t rows(store), cols(store), subDims(store),
+        centroidCount(store);
+    if (subDims == 0 || centroidCount > 256)
+        throw Exception("FastText_Quantized_Matrix::reconstitute: "
+                        "invalid quantization");
+    this->rows = rows;
+    this->cols = cols;
+    this->subDims = subDims;
+    this->centroidCount = centroidCount;
+    centroids.resize((size_t)subvectorCount() * centroidCount * subDims);
+    for (float & c: centroids)
+        store >> c;
+    codes.resize((size_t)rows * subvectorCount());
+    store.load_binary(codes.data(), codes.size());
+    for (uint8_t code: codes) {
+        if (code >= centroidCount)
+            throw Exception("FastText_Quantized_Matrix::reconstitute: "
+                            "invalid code");
+    }
+}
+
+
+/*****************************************************************************/
+/* FASTTEXT_CLASSIFIER                                                       */
 /*****************************************************************************/
 
 FastTest_Classifier::FastTest_Classifier()
@@ -62,6 +234,7 @@ swap(FastTest_Classifier & other)
 
     std::swap(encoding, other.encoding);  ///< How the outputs are represented
     std::swap(fastText_, other.fastText_);
+    std::swap(quantizedInput_, other.quantizedInput_);
     std::swap(features, other.features);
     std::swap(featureMap, other.featureMap);    
 }
@@ -81,7 +254,7 @@ predict(const Feature_Set & infeatures,
         PredictionContext * context) const
 {
     ExcAssert(fastText_);
-    ExcAssert(fastText_->model_);
+    ExcAssert(fastText_->model_ || quantizedInput_);
     Label_Dist results;
     results.resize(label_count());   
 
@@ -96,7 +269,34 @@ predict(const Feature_Set & infeatures,
         }
     }
 
-    if (!words.empty()) {
+    if (!words.empty() && quantizedInput_) {
+        // Same as fastText's prediction, but with the approximated inputs:
+        // log of the softmax over the output rows of the mean embedding
+        int dims = fastText_->args_->dim;
+        const fasttext::Matrix & wo = *fastText_->output_;
+        std::vector<float> hidden(dims, 0.0f);
+        for (int32_t w: words)
+            quantizedInput_->addRow(hidden.data(), w, 1.0f / words.size());
+
+        std::vector<float> output(wo.m_);
+        float maxOutput = -INFINITY;
+        for (int i = 0;  i < wo.m_;  ++i) {
+            const fasttext::real * row = wo.data_ + i * wo.n_;
+            float total = 0.0f;
+            for (int d = 0;  d < dims;  ++d)
+                total += row[d] * hidden[d];
+            output[i] = total;
+            maxOutput = std::max(maxOutput, total);
+        }
+        float z = 0.0f;
+        for (float & o: output) {
+            o = std::exp(o - maxOutput);
+            z += o;
+        }
+        for (int i = 0;  i < wo.m_ && i < results.size();  ++i)
+            results[i] = std::log(output[i] / z);
+    }
+    else if (!words.empty()) {
         fasttext::Vector hidden(fastText_->args_->dim);
         fasttext::Vector output(label_count());
         std::vector<std::pair<fasttext::real,int32_t>> modelPredictions;
@@ -122,8 +322,15 @@ explain(const Feature_Set & feature_set,
     Explanation result;
     auto dims = fastText_->args_->dim;
 
-    auto getEl = [] (const fasttext::Matrix& mat, size_t i, size_t j) -> float {
-        return mat.data_[i * mat.n_ + j];
+    std::vector<float> inputRow(dims);
+    auto getRow = [&] (size_t i) -> const float * {
+        if (!quantizedInput_) {
+            const fasttext::Matrix & mat = *fastText_->input_;
+            return mat.data_ + i * mat.n_;
+        }
+        std::fill(inputRow.begin(), inputRow.end(), 0.0f);
+        quantizedInput_->addRow(inputRow.data(), i);
+        return inputRow.data();
     };
 
     fasttext::Vector outputVector(dims);
@@ -135,9 +342,10 @@ explain(const Feature_Set & feature_set,
         auto it = featureMap.find(feature);
         if (it != featureMap.end()) {
             size_t f = (*it);
+            const float * row = getRow(f);
             float sum = 0.0f;
             for (int dim = 0; dim < fastText_->args_->dim; ++dim) {
-                sum += getEl(*fastText_->input_, f, dim)*outputVector[dim];
+                sum += row[dim]*outputVector[dim];
             }
 
             result.feature_weights[feature] = sum;
@@ -176,6 +384,8 @@ print() const
 {
     string result = "Fast Text Summary: ";
     result += std::to_string(fastText_->args_->dim) + " dims ";
+    if (quantizedInput_)
+        result += "quantized ";
     return result;
 }
 
@@ -218,7 +428,7 @@ serialize(DB::Store_Writer & store) const
     };
 
     store << class_id();
-    store << compact_size_t(0);  // version
+    store << compact_size_t(1);  // version
     store << compact_size_t(label_count());
     feature_space_->serialize(store, predicted_);
 
@@ -229,7 +439,10 @@ serialize(DB::Store_Writer & store) const
 
     //serialize input and output matrices
     ExcAssert(fastText_);
-    serializeFasttextMatrix(fastText_->input_);
+    store << (bool)quantizedInput_;  // added in version 1
+    if (quantizedInput_)
+        quantizedInput_->serialize(store);
+    else serializeFasttextMatrix(fastText_->input_);
     serializeFasttextMatrix(fastText_->output_);
 
     size_t dims = fastText_->args_->dim;
@@ -287,7 +500,8 @@ reconstitute(DB::Store_Reader & store,
     compact_size_t version(store);
     
     switch (version) {
-    case 0: {    
+    case 0:
+    case 1: {
         compact_size_t label_count(store);
         feature_space->reconstitute(store, predicted_);
         Classifier_Impl::init(feature_space, predicted_);
@@ -300,11 +514,24 @@ reconstitute(DB::Store_Reader & store,
 
         fastText_ = make_shared<fasttext::FastText>();
 
-        fastText_->input_ = reconstituteFasttextMatrix();
+        bool isQuantized = false;
+        if (version >= 1)
+            store >> isQuantized;
+
+        quantizedInput_.reset();
+        if (isQuantized) {
+            auto quantized = std::make_shared<FastText_Quantized_Matrix>();
+            quantized->reconstitute(store);
+            quantizedInput_ = quantized;
+        }
+        else fastText_->input_ = reconstituteFasttextMatrix();
         fastText_->output_ = reconstituteFasttextMatrix();
         fastText_->args_ = make_shared<fasttext::Args>();
 
-        fastText_->model_ = std::make_shared<fasttext::Model>(fastText_->input_, fastText_->output_, fastText_->args_, 0);
+        // Quantized models predict without a fastText model, since it
+        // needs the float input matrix
+        if (!isQuantized)
+            fastText_->model_ = std::make_shared<fasttext::Model>(fastText_->input_, fastText_->output_, fastText_->args_, 0);
 
         size_t dims = 0;
         store >> dims;
@@ -341,6 +568,23 @@ class_id() const
     return "FASTTEXT";
 }
 
+void
+FastTest_Classifier::
+quantize(int subDims)
+{
+    ExcAssert(fastText_);
+    if (quantizedInput_)
+        return;
+
+    const fasttext::Matrix & input = *fastText_->input_;
+    auto quantized = std::make_shared<FastText_Quantized_Matrix>();
+    quantized->train(input.data_, input.m_, input.n_, subDims);
+    quantizedInput_ = quantized;
+
+    fastText_->model_.reset();
+    fastText_->input_.reset();
+}
+
 FastTest_Classifier *
 FastTest_Classifier::
 make_copy() const
@@ -19,6 +19,52 @@ namespace ML {
 class Training_Data;
 
 
+/*****************************************************************************/
+/* FASTTEXT_QUANTIZED_MATRIX                                                 */
+/*****************************************************************************/
+
+/** Product quantized version of a fastText embedding matrix, used to serve
+    a model in much less memory.  Each row is split into subvectors of
+    subDims dimensions, and each subvector is replaced by the index of the
+    nearest of (up to) 256 centroids found by k-means over that subvector
+    of all the rows.  A row therefore takes one byte per subvector instead
+    of four bytes per dimension.
+*/
+
+struct FastText_Quantized_Matrix {
+    int rows = 0;
+    int cols = 0;
+    int subDims = 0;          ///< Dimensions per subvector (last may be less)
+    int centroidCount = 0;    ///< Centroids per subvector, at most 256
+
+    /// Centroids, indexed by [subvector][centroid][dimension], with subDims
+    /// entries per centroid even for a shorter last subvector
+    std::vector<float> centroids;
+
+    /// Code for each [row][subvector]
+    std::vector<uint8_t> codes;
+
+    int subvectorCount() const { return (cols + subDims - 1) / subDims; }
+
+    /** Quantize the rows x cols matrix in data.  The subvectors are
+        quantized in parallel.
+    */
+    void train(const float * data, int rows, int cols, int subDims,
+               int iterations = 25);
+
+    /** Add scale times the (approximated) given row to the cols values
+        in out.
+    */
+    void addRow(float * out, int row, float scale = 1.0f) const;
+
+    /** Bytes of memory used. */
+    size_t memusage() const;
+
+    void serialize(DB::Store_Writer & store) const;
+    void reconstitute(DB::Store_Reader & store);
+};
+
+
 /*****************************************************************************/
 /* FastTest_Classifier                                                       */
 /*****************************************************************************/
@@ -93,8 +139,18 @@ public:
 
     virtual FastTest_Classifier * make_copy() const;
 
+    /** Replace the input embeddings by a product quantized version of
+        them.  Prediction and explanation then use the approximated
+        embeddings, and the float matrix is freed.
+    */
+    void quantize(int subDims);
+
+    /** Is the input matrix quantized? */
+    bool quantized() const { return !!quantizedInput_; }
+
     Output_Encoding encoding;  ///< How the outputs are represented
     std::shared_ptr<fasttext::FastText> fastText_;
+    std::shared_ptr<const FastText_Quantized_Matrix> quantizedInput_;
     std::vector<Feature> features;
 
     //The feature map needs to be mutable else the map doesnt work in predict
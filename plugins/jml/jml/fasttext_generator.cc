@@ -50,6 +50,8 @@ configure(const Configuration & config, vector<string> & unparsedKeys)
     config.findAndRemove(epoch, "epoch", unparsedKeys);
     config.findAndRemove(dims, "dims", unparsedKeys);
     config.findAndRemove(verbose, "verbosity", unparsedKeys);
+    config.findAndRemove(quantize, "quantize", unparsedKeys);
+    config.findAndRemove(quantizeDims, "quantizeDims", unparsedKeys);
 }
 
 void
@@ -59,7 +61,9 @@ defaults()
     Classifier_Generator::defaults();
     epoch = 5;
     dims = 100;
-    verbose = 0;  
+    verbose = 0;
+    quantize = false;
+    quantizeDims = 2;
 }
 
 Config_Options
@@ -73,7 +77,13 @@ options() const
         .add("dims", dims, "1+",
              "Number of dimensions in the embedding")
         .add("verbosity", verbose, "0+",
-             "Level of verbosity in standard output");
+             "Level of verbosity in standard output")
+        .add("quantize", quantize,
+             "Product quantize the input embeddings once trained, so that "
+             "the model takes much less memory")
+        .add("quantizeDims", quantizeDims, "1+",
+             "Number of embedding dimensions quantized together to one byte "
+             "when quantize is set");
     return result;
 }
 
@@ -121,23 +131,46 @@ FastText_Generator::
     }
 
     //0 : Initialize
-    int64_t ntokens = 0;
-    for (int i = 0; i < training_data.example_count(); ++i) {
-        const Feature_Set & featureSet = training_data[i];
+    // Each example is converted to fastText's words and labels once here,
+    // rather than looking up its features in the feature map on every
+    // epoch.
+    struct Line {
+        std::vector<int32_t> words;
+        std::vector<int32_t> labels;
+        int64_t ntokens = 0;     ///< Total count of the (non-label) features
+        int64_t nfeatures = 0;   ///< Number of features, including the label
+    };
 
-        auto it = featureSet.begin();
-        auto itEnd = featureSet.end();
+    std::vector<Line> lines(training_data.example_count());
 
-        while (it != itEnd) {
-            std::pair<Feature, float> feature = *it;
-            if (feature.first == predicted) {
-                labelCount[feature.second]++;
-            }
-            else {
-                ntokens += (int64_t)feature.second;
+    auto onExample = [&] (size_t i)
+        {
+            Line & line = lines[i];
+            for (const std::pair<Feature, float> & feature: training_data[i]) {
+                if (feature.first == predicted) {
+                    //value of the label feature is the label
+                    line.labels.push_back(feature.second);
+                }
+                else {
+                    line.ntokens += (int64_t)feature.second;
+                    auto featureit = output->featureMap.find(feature.first);
+                    if (featureit != output->featureMap.end()) {
+                        size_t f = (*featureit);
+                        for (int i = 0; i < feature.second; ++i)
+                            line.words.push_back(f);
+                    }
+                }
+                line.nfeatures++;
             }
-            ++it;
-        }
+        };
+
+    parallelMap(0, lines.size(), onExample);
+
+    int64_t ntokens = 0;
+    for (const Line & line: lines) {
+        for (int32_t label: line.labels)
+            labelCount[label]++;
+        ntokens += line.ntokens;
     }
 
     args_->model = fasttext::model_name::sup;
@@ -167,7 +200,6 @@ FastText_Generator::
       model.setTargetCounts(labelCount);
     
       int64_t localTokenCount = 0;
-      std::vector<int32_t> line, labels;
       while (tokenCount < args_->epoch * ntokens) {
 
         //if we reach the end we wrap around
@@ -177,29 +209,9 @@ FastText_Generator::
         fasttext::real progress = fasttext::real(tokenCount) / (args_->epoch * ntokens);
         fasttext::real lr = args_->lr * (1.0 - progress);
 
-        const Feature_Set & lineFeatureSet = training_data[start];
-        auto it = lineFeatureSet.begin();
-        auto itEnd = lineFeatureSet.end();
-
-        line.clear();
-        labels.clear();
-
-        while (it != itEnd) {
-            std::pair<Feature, float> feature = *it;
-            if (feature.first == predicted) {
-                labels.push_back(feature.second); //value of the label feature is the label
-            }
-            else {
-                auto featureit = output->featureMap.find(feature.first);
-                if (featureit != output->featureMap.end()) {
-                    size_t f = (*featureit);
-                    for (int i = 0; i < feature.second; ++i)
-                        line.push_back(f);        
-                }
-            }
-            localTokenCount++;
-            ++it;
-        }       
+        const std::vector<int32_t> & line = lines[start].words;
+        const std::vector<int32_t> & labels = lines[start].labels;
+        localTokenCount += lines[start].nfeatures;
 
         start++;
 
@@ -233,7 +245,10 @@ FastText_Generator::
 
     //for prediction
     fastTextModel.model_ = std::make_shared<fasttext::Model>(fastTextModel.input_, fastTextModel.output_, fastTextModel.args_, 0);
-   
+
+    if (quantize)
+        output->quantize(quantizeDims);
+
     return output;
 }
 
@@ -62,7 +62,8 @@ public:
     int epoch = 5;
     int dims = 100;
     int verbose = 0;
-   
+    bool quantize = false;
+    int quantizeDims = 2;
 };
 
 }
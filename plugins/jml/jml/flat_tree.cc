@@ -0,0 +1,133 @@
+/* flat_tree.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Flattened decision tree layout for optimized prediction.
+*/
+
+#include "flat_tree.h"
+#include "classifier.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* FLAT_TREE                                                                 */
+/*****************************************************************************/
+
+void
+Flat_Tree::
+clear()
+{
+    nodes.clear();
+    leaves.clear();
+    root = 0;
+    nl = 0;
+}
+
+void
+Flat_Tree::
+compile(const Tree::Ptr & root, int nl,
+        const Optimization_Info & info)
+{
+    ExcAssertGreater(nl, 0);
+
+    clear();
+    this->nl = nl;
+
+    // Leaf 0 is the empty leaf that missing children go to
+    add_leaf(distribution<float>());
+
+    this->root = compile_recursive(root, info);
+}
+
+int32_t
+Flat_Tree::
+add_leaf(const distribution<float> & pred)
+{
+    int32_t result = ~int32_t(leaves.size() / nl);
+    size_t n = std::min<size_t>(pred.size(), nl);
+    leaves.insert(leaves.end(), pred.begin(), pred.begin() + n);
+    leaves.resize(leaves.size() + nl - n, 0.0f);
+    return result;
+}
+
+int32_t
+Flat_Tree::
+compile_recursive(const Tree::Ptr & ptr,
+                  const Optimization_Info & info)
+{
+    if (!ptr)
+        return ~0;
+    if (!ptr.node())
+        return add_leaf(ptr.leaf()->pred);
+
+    const Tree::Node & node = *ptr.node();
+
+    if (node.split.op() > Split::NOT_MISSING)
+        throw Exception("Flat_Tree::compile(): invalid split op");
+
+    int32_t result = nodes.size();
+    nodes.emplace_back();
+    nodes[result].split_val = node.split.split_val();
+    nodes[result].feature = info.get_optimized_index(node.split.feature());
+    nodes[result].op = node.split.op();
+
+    // The vector may be reallocated by the recursive calls, so we can't
+    // hold on to a reference
+    int32_t child_false = compile_recursive(node.child_false, info);
+    int32_t child_true = compile_recursive(node.child_true, info);
+    int32_t child_missing = compile_recursive(node.child_missing, info);
+
+    nodes[result].child[false] = child_false;
+    nodes[result].child[true] = child_true;
+    nodes[result].child[MISSING] = child_missing;
+
+    return result;
+}
+
+void
+Flat_Tree::
+accumulate(const float * features, size_t stride,
+           size_t num_examples,
+           double * accum, double weight) const
+{
+    enum { BLOCK = 8 };
+
+    for (size_t start = 0;  start < num_examples;  start += BLOCK) {
+        size_t n = std::min<size_t>(BLOCK, num_examples - start);
+        const float * block = features + start * stride;
+
+        int32_t current[BLOCK];
+        std::fill(current, current + n, root);
+
+        // Take one step for each example that is still in the tree,
+        // until they have all reached a leaf
+        for (bool active = root >= 0;  active;) {
+            active = false;
+            for (size_t i = 0;  i < n;  ++i) {
+                if (current[i] < 0)
+                    continue;
+                const Node & node = nodes[current[i]];
+                current[i]
+                    = node.child[branch(node,
+                                        block[i * stride + node.feature])];
+                active = active || current[i] >= 0;
+            }
+        }
+
+        for (size_t i = 0;  i < n;  ++i) {
+            const float * leaf = &leaves[~current[i] * nl];
+            double * out = accum + (start + i) * nl;
+            for (int j = 0;  j < nl;  ++j)
+                out[j] += leaf[j] * weight;
+        }
+    }
+}
+
+} // namespace ML
@@ -0,0 +1,105 @@
+/* flat_tree.h                                                     -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Flattened decision tree layout for optimized prediction.
+*/
+
+#pragma once
+
+#include "tree.h"
+#include "split.h"
+#include <vector>
+#include <stdint.h>
+#include <cmath>
+
+
+namespace ML {
+
+
+struct Optimization_Info;
+
+
+/*****************************************************************************/
+/* FLAT_TREE                                                                 */
+/*****************************************************************************/
+
+/** A decision tree compiled for prediction over dense feature vectors.
+    Instead of following pointers between separately allocated nodes,
+    the nodes live contiguously in one array (in depth first order, so
+    that the common path is mostly sequential) and hold the index of
+    their feature in the dense vector directly.  The leaf distributions
+    are packed into a second array, label_count() floats each.
+
+    Children are referred to by their index in the node array, or for
+    leaves by the bitwise complement of their leaf number.  A missing
+    child points to a leaf of all zeros, so that every walk ends at a
+    leaf.
+*/
+
+struct Flat_Tree {
+    struct Node {
+        float split_val;    ///< Value to compare the feature to
+        uint32_t feature;   ///< Index of feature in the dense vector
+        uint32_t op;        ///< Split::Op to apply
+        int32_t child[3];   ///< false, true and MISSING children
+    };
+
+    std::vector<Node> nodes;
+    std::vector<float> leaves;  ///< nl values per leaf
+    int32_t root = 0;
+    int nl = 0;
+
+    bool empty() const { return nl == 0; }
+
+    void clear();
+
+    /** Compile the given tree, which has nl labels, for the given
+        optimized feature mapping. */
+    void compile(const Tree::Ptr & root, int nl,
+                 const Optimization_Info & info);
+
+    /** Which branch (false, true or MISSING) a split with the given value
+        and Split::Op takes for the given value.  Same as Split::apply(). */
+    static MLDB_ALWAYS_INLINE int
+    branch(float split_val, uint32_t op, float val)
+    {
+        if (std::isnan(val))
+            return MISSING;
+        int all = (val < split_val) | ((val == split_val) << 1) | 4;
+        return (all >> op) & 1;
+    }
+
+    static MLDB_ALWAYS_INLINE int branch(const Node & node, float val)
+    {
+        return branch(node.split_val, node.op, val);
+    }
+
+    /** Return the leaf values reached by the given dense feature vector. */
+    MLDB_ALWAYS_INLINE const float * predict(const float * features) const
+    {
+        int32_t current = root;
+        while (current >= 0) {
+            const Node & node = nodes[current];
+            current = node.child[branch(node, features[node.feature])];
+        }
+        return &leaves[~current * nl];
+    }
+
+    /** Add weight times the prediction for each of the num_examples dense
+        feature vectors (stride floats apart) to the nl entries of accum
+        for that example.  Blocks of examples are walked down the tree
+        together, so that the memory accesses for one can overlap with
+        those for the others.
+    */
+    void accumulate(const float * features, size_t stride,
+                    size_t num_examples,
+                    double * accum, double weight) const;
+
+private:
+    int32_t compile_recursive(const Tree::Ptr & ptr,
+                              const Optimization_Info & info);
+
+    int32_t add_leaf(const distribution<float> & pred);
+};
+
+} // namespace ML
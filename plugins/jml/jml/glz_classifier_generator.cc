@@ -17,6 +17,7 @@
 #include "mldb/plugins/jml/algebra/matrix_ops.h"
 #include "mldb/plugins/jml/algebra/lapack.h"
 #include "mldb/plugins/jml/algebra/least_squares.h"
+#include "mldb/plugins/jml/algebra/sparse_irls.h"
 #include "mldb/arch/timers.h"
 #include "mldb/base/parallel.h"
 #include "mldb/utils/string_functions.h"
@@ -52,6 +53,7 @@ configure(const Configuration & config, vector<string> & unparsedKeys)
     config.findAndRemove(link_function, "link_function", unparsedKeys);
     config.findAndRemove(normalize, "normalize", unparsedKeys);
     config.findAndRemove(condition, "condition", unparsedKeys);
+    config.findAndRemove(sparse, "sparse", unparsedKeys);
     config.findAndRemove(regularization, "regularization", unparsedKeys);
     config.findAndRemove(regularization_factor, "regularization_factor", unparsedKeys);
     config.findAndRemove(max_regularization_iteration, "max_regularization_iteration", unparsedKeys);
@@ -69,6 +71,7 @@ defaults()
     do_decode = true;
     normalize = true;
     condition = false;
+    sparse = false;
     regularization = Regularization_l2;
     regularization_factor = 1e-5;
     max_regularization_iteration = 1000;
@@ -108,6 +111,11 @@ options() const
         .add("condition", condition,
              "condition features to have no correlation for greater numeric"
              " stability (but much slower training)")
+        .add("sparse", sparse,
+             "train directly on the non-zero feature values, which is much"
+             " faster and uses much less memory when there are many features"
+             " that are mostly missing or zero.  Normalization only scales"
+             " features, and condition is ignored")
         .add("feature_proportion", feature_proportion, "0 to 1",
              "use only a (random) portion of available features when training"
              " classifier");
@@ -292,33 +300,14 @@ train_weighted(Thread_Context & thread_context,
     /* Get the labels by example. */
     const vector<Label> & labels = data.index().labels(predicted);
     
-    // Use double precision, we have enough memory (<= 1GB)
-    // NOTE: always on due to issues with convergence
-    boost::multi_array<double, 2> dense_data(boost::extents[nv][nx2]);  // training data, dense
-        
     distribution<double> model(nx2, 0.0);  // to initialise weights, correct
     vector<distribution<double> > w(nl, model);       // weights for each label
     vector<distribution<double> > correct(nl, model); // correct values
 
-    cerr << "setup: " << t.elapsed() << endl;
-    t.restart();
-        
-    auto onIndex = [&] (int index)
+    auto onLabels = [&] (int index)
         {
             int x = indexes[index];
 
-            distribution<float> decoded = result.decode(data[x]);
-            if (add_bias) decoded.push_back(1.0);
-            
-            //cerr << "x = " << x << "  decoded = " << decoded << endl;
-            
-            /* Record the values of the variables. */
-            assert(decoded.size() == nv);
-            for (unsigned v = 0;  v < decoded.size();  ++v) {
-                if (!isfinite(decoded[v])) decoded[v] = 0.0;
-                dense_data[v][index] = decoded[v];
-            }
-            
             /* Record the correct label. */
             if (regression_problem) {
                 correct[0][index] = labels[x].value();
@@ -336,6 +325,40 @@ train_weighted(Thread_Context & thread_context,
                 }
             }
         };
+
+    if (sparse) {
+        for (unsigned index = 0;  index < nx2;  ++index)
+            onLabels(index);
+        train_sparse(data, indexes, correct, w, result);
+        cerr << "sparse irls: " << t.elapsed() << endl;
+        return 0.0;
+    }
+
+    // Use double precision, we have enough memory (<= 1GB)
+    // NOTE: always on due to issues with convergence
+    boost::multi_array<double, 2> dense_data(boost::extents[nv][nx2]);  // training data, dense
+        
+    cerr << "setup: " << t.elapsed() << endl;
+    t.restart();
+        
+    auto onIndex = [&] (int index)
+        {
+            int x = indexes[index];
+
+            distribution<float> decoded = result.decode(data[x]);
+            if (add_bias) decoded.push_back(1.0);
+            
+            //cerr << "x = " << x << "  decoded = " << decoded << endl;
+            
+            /* Record the values of the variables. */
+            assert(decoded.size() == nv);
+            for (unsigned v = 0;  v < decoded.size();  ++v) {
+                if (!isfinite(decoded[v])) decoded[v] = 0.0;
+                dense_data[v][index] = decoded[v];
+            }
+
+            onLabels(index);
+        };
     
     MLDB::parallelMap(0, indexes.size(), onIndex);
 
@@ -384,32 +407,37 @@ train_weighted(Thread_Context & thread_context,
     int nlr = nl;
     if (nl == 2) nlr = 1;
         
-    /* Perform a GLZ for each label. */
+    /* Perform a GLZ for each label.  The labels are independent, so they
+       are trained in parallel. */
     result.weights.clear();
-    double extra_bias = 0.0;
-    for (unsigned l = 0;  l < nlr;  ++l) {
-        //cerr << "l = " << l << "  correct[l] = " << correct[l]
-        //     << " w = " << w[l] << endl;
+    result.weights.resize(nlr);
+
+    auto onLabel = [&] (size_t l)
+        {
+            //cerr << "l = " << l << "  correct[l] = " << correct[l]
+            //     << " w = " << w[l] << endl;
             
-        distribution<double> trained
-            = perform_irls(correct[l], dense_data, w[l], link_function,
-                           regularization, regularization_factor, max_regularization_iteration, regularization_epsilon, 
-                           condition);
+            distribution<double> trained
+                = perform_irls(correct[l], dense_data, w[l], link_function,
+                               regularization, regularization_factor, max_regularization_iteration, regularization_epsilon, 
+                               condition);
 
-        trained /= stds;
+            trained /= stds;
 
-        extra_bias = - (trained.dotprod(means));
+            double extra_bias = - (trained.dotprod(means));
 
-        if (extra_bias != 0.0) {
-            if (!add_bias)
-                throw Exception("extra bias but nowhere to put it");
-            trained.back() += extra_bias;
-        }
+            if (extra_bias != 0.0) {
+                if (!add_bias)
+                    throw Exception("extra bias but nowhere to put it");
+                trained.back() += extra_bias;
+            }
         
-        //cerr << "l = " << l <<"  param = " << param << endl;
+            //cerr << "l = " << l <<"  param = " << param << endl;
             
-        result.weights.push_back(trained.cast<float>());
-    }
+            result.weights[l] = trained.cast<float>();
+        };
+
+    MLDB::parallelMap(0, nlr, onLabel);
 
     cerr << "irls: " << t.elapsed() << endl;
     t.restart();
@@ -426,6 +454,97 @@ train_weighted(Thread_Context & thread_context,
 }
 
 
+void
+GLZ_Classifier_Generator::
+train_sparse(const Training_Data & data,
+             const std::vector<int> & indexes,
+             const std::vector<distribution<double> > & correct,
+             const std::vector<distribution<double> > & w,
+             GLZ_Classifier & result) const
+{
+    size_t nl = result.label_count();
+    size_t nx2 = indexes.size();
+    size_t nf = result.features.size();
+    size_t nv = nf + add_bias;
+
+    Timer t;
+
+    /* Decode each example, keeping only the non-zero values, and then put
+       them in columns.  The columns are filled in example order, which
+       keeps the memory accesses in sparse_irls() sequential. */
+    vector<vector<pair<int, float> > > rows(nx2);
+
+    auto onIndex = [&] (size_t index)
+        {
+            distribution<float> decoded = result.decode(data[indexes[index]]);
+            for (unsigned v = 0;  v < nf;  ++v) {
+                if (isfinite(decoded[v]) && decoded[v] != 0.0)
+                    rows[index].emplace_back(v, decoded[v]);
+            }
+        };
+
+    MLDB::parallelMap(0, nx2, onIndex);
+
+    Sparse_Columns x(nv, nx2);
+    for (unsigned index = 0;  index < nx2;  ++index) {
+        for (auto & val: rows[index])
+            x.columns[val.first].add(index, val.second);
+        vector<pair<int, float> >().swap(rows[index]);
+        if (add_bias)
+            x.columns[nf].add(index, 1.0);
+    }
+
+    cerr << "sparse marshalling: " << t.elapsed() << " with "
+         << x.nonzero_count() << " non-zeros" << endl;
+    t.restart();
+
+    /* Scale to unit variance.  We don't center the features, as that would
+       make all of the zeros non-zero. */
+    distribution<double> stds(nv, 1.0);
+    for (unsigned v = 0;  v < nf && normalize;  ++v) {
+        const Sparse_Columns::Column & c = x.columns[v];
+        double total = 0.0, total_sqr = 0.0;
+        for (float val: c.values) {
+            total += val;
+            total_sqr += val * val;
+        }
+
+        double mean = total / nx2;
+        double var = total_sqr / nx2 - mean * mean;
+        if (var > 0.0)
+            stds[v] = sqrt(var);
+    }
+
+    if (normalize)
+        x.scale(1.0 / stds);
+
+    int nlr = nl;
+    if (nl == 2) nlr = 1;
+
+    vector<distribution<double> > trained
+        = sparse_irls(x,
+                      vector<distribution<double> >(correct.begin(),
+                                                    correct.begin() + nlr),
+                      vector<distribution<double> >(w.begin(),
+                                                    w.begin() + nlr),
+                      link_function, regularization, regularization_factor,
+                      add_bias ? nf : -1,
+                      max_regularization_iteration, regularization_epsilon);
+
+    result.weights.clear();
+    for (auto & params: trained) {
+        params /= stds;
+        result.weights.push_back(params.cast<float>());
+    }
+
+    if (nl == 2) {
+        // weights for second label are the mirror of those of the first
+        // label
+        result.weights.push_back(-1.0F * result.weights.front());
+    }
+}
+
+
 /*****************************************************************************/
 /* REGISTRATION                                                              */
 /*****************************************************************************/
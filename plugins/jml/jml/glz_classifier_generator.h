@@ -68,6 +68,7 @@ public:
     int max_regularization_iteration; ///< Maximum number of iterations in regularization
     double regularization_epsilon; ///< Epsilon to use when looking for convergence in regularization
     bool condition;         ///< Do we condition the feature matrix beforehand?
+    bool sparse;            ///< Do we train directly on the sparse data?
 
     Link_Function link_function;
     float feature_proportion;
@@ -82,6 +83,14 @@ public:
                          const boost::multi_array<float, 2> & weights,
                          const std::vector<Feature> & features,
                          GLZ_Classifier & result) const;
+
+private:
+    /** Training with sparse_irls() on the non-zero values only. */
+    void train_sparse(const Training_Data & data,
+                      const std::vector<int> & indexes,
+                      const std::vector<distribution<double> > & correct,
+                      const std::vector<distribution<double> > & w,
+                      GLZ_Classifier & result) const;
 };
 
 
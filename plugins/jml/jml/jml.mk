@@ -10,6 +10,7 @@ LIBBOOSTING_SOURCES := \
         data_aliases.cc \
         decoded_classifier.cc \
         decision_tree.cc \
+        flat_tree.cc \
         null_feature_space.cc \
         decoder.cc \
         dense_features.cc \
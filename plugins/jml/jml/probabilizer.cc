@@ -1123,6 +1123,101 @@ operator >> (DB::Store_Reader & store, GLZ_Probabilizer & prob)
 }
 
 
+/*****************************************************************************/
+/* PROBABILIZER_TABLE                                                        */
+/*****************************************************************************/
+
+Probabilizer_Table::
+Probabilizer_Table()
+    : link(LOGIT), slope(1.0), intercept(0.0),
+      etaMin(0.0), etaMax(0.0), scale(0.0)
+{
+}
+
+Probabilizer_Table::
+Probabilizer_Table(const GLZ_Probabilizer & prob, int knots)
+    : link(prob.link), etaMin(0.0), etaMax(0.0), scale(0.0)
+{
+    if (prob.params.size() != 1 || prob.params[0].size() != 2)
+        throw Exception("Probabilizer_Table: probabilizer must have a "
+                        "single output with a single input");
+    if (knots < 2)
+        throw Exception("Probabilizer_Table: need at least two knots");
+
+    slope = prob.params[0][0];
+    intercept = prob.params[0][1];
+
+    // Range of eta over which the link isn't saturated.  Outside of it the
+    // probability is within a few 1e-9 of 0 or 1.
+    switch (link) {
+    case LOGIT:         etaMin = -20.0;  etaMax = 20.0;  break;
+    case PROBIT:        etaMin = -8.0;   etaMax = 8.0;   break;
+    case COMP_LOG_LOG:  etaMin = -20.0;  etaMax = 4.0;   break;
+    default:
+        return;  // calculated directly
+    }
+
+    scale = (knots - 1) / (etaMax - etaMin);
+    values.resize(knots);
+    for (unsigned i = 0;  i < knots;  ++i)
+        values[i] = apply_link_inverse(etaMin + i / scale, link);
+}
+
+float
+Probabilizer_Table::
+applyExact(double eta) const
+{
+    return apply_link_inverse(eta, link);
+}
+
+float
+Probabilizer_Table::
+apply(float score) const
+{
+    double eta = slope * score + intercept;
+    if (values.empty() || !(eta >= etaMin && eta <= etaMax))
+        return applyExact(eta);
+
+    double pos = (eta - etaMin) * scale;
+    unsigned i = std::min<unsigned>(pos, values.size() - 2);
+    float frac = pos - i;
+    return values[i] + (values[i + 1] - values[i]) * frac;
+}
+
+void
+Probabilizer_Table::
+apply(const float * scores, float * result, size_t n) const
+{
+    if (values.empty()) {
+        for (size_t i = 0;  i < n;  ++i)
+            result[i] = applyExact(slope * scores[i] + intercept);
+        return;
+    }
+
+    const float * v = values.data();
+    const double maxPos = values.size() - 1;
+
+    // Interpolate everything, clamping to the ends of the table (written
+    // so that a NaN is clamped too)
+    for (size_t i = 0;  i < n;  ++i) {
+        double eta = slope * scores[i] + intercept;
+        double pos = (eta - etaMin) * scale;
+        pos = pos > 0.0 ? pos : 0.0;
+        pos = pos < maxPos ? pos : maxPos;
+        int k = std::min<int>(pos, maxPos - 1);
+        float frac = pos - k;
+        result[i] = v[k] + (v[k + 1] - v[k]) * frac;
+    }
+
+    // Then calculate those that were clamped directly
+    for (size_t i = 0;  i < n;  ++i) {
+        double eta = slope * scores[i] + intercept;
+        if (!(eta >= etaMin && eta <= etaMax))
+            result[i] = applyExact(eta);
+    }
+}
+
+
 /*****************************************************************************/
 /* REGISTRATION                                                              */
 /*****************************************************************************/
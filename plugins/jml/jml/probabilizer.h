@@ -331,6 +331,49 @@ operator << (DB::Store_Writer & store, const GLZ_Probabilizer & prob);
 DB::Store_Reader &
 operator >> (DB::Store_Reader & store, GLZ_Probabilizer & prob);
 
+/*****************************************************************************/
+/* PROBABILIZER_TABLE                                                        */
+/*****************************************************************************/
+
+/** A single output (regression) GLZ_Probabilizer, precompiled for serving.
+    The probability is a monotone function of eta = a x + c, so the link
+    inverse is sampled at evenly spaced values of eta and evaluated by
+    linear interpolation between them, which keeps it monotone.  Links
+    that saturate (logit, probit and complementary log-log) are tabulated
+    over the range where they aren't saturated; outside of it, and for the
+    linear and log links which are cheap to evaluate anyway, the link
+    inverse is calculated directly.  The interpolation error is of the
+    order of 1e-7, which is below the precision of the float result.
+*/
+
+struct Probabilizer_Table {
+    Probabilizer_Table();
+
+    /** Compile the given probabilizer, which must have a single output. */
+    Probabilizer_Table(const GLZ_Probabilizer & prob, int knots = 16384);
+
+    /** Probability for a single score.  Same as prob.apply({score})[0]. */
+    float apply(float score) const;
+
+    /** Probabilities for n scores at once.  The interpolation runs over
+        the whole array without any branches, so that it can be
+        vectorized, and the few scores outside of the table are fixed up
+        afterwards.
+    */
+    void apply(const float * scores, float * result, size_t n) const;
+
+    Link_Function link;
+    double slope;               ///< a in eta = a x + c
+    double intercept;           ///< c in eta = a x + c
+    double etaMin, etaMax;      ///< Range of eta covered by the table
+    double scale;               ///< Knots per unit of eta
+    std::vector<float> values;  ///< Link inverse at each knot
+
+private:
+    float applyExact(double eta) const;
+};
+
+
 /*****************************************************************************/
 /* PROBABILIZER                                                          */
 /*****************************************************************************/
@@ -4,23 +4,25 @@
    CUDA version of stump training code.
 */
 
-#include "arch/exception.h"
-#include "compiler/compiler.h"
+#include "mldb/arch/exception.h"
+#include "mldb/compiler/compiler.h"
 #include <cstdio>
 #include <iostream>
+#include <memory>
 #include <boost/timer.hpp>
 #include <boost/utility.hpp>
 #include <boost/scoped_array.hpp>
 #include <boost/shared_array.hpp>
 #include "stump_training_cuda.h"
 #include "fixed_point_accum.h"
-#include "arch/cuda/device_data.h"
-#include "arch/bit_range_ops.h"
-#include "arch/bitops.h"
-#include "math/xdiv.h"
+#include "mldb/arch/cuda/device_data.h"
+#include "mldb/arch/bit_range_ops.h"
+#include "mldb/arch/bitops.h"
+#include "mldb/utils/xdiv.h"
 #include "bit_compressed_index.h"
 
 using namespace std;
+using MLDB::Exception;
 
 typedef ML::CUDA::Test_Buckets_Binsym::Float Float;
 typedef ML::CUDA::Test_Buckets_Binsym::TwoBuckets TwoBuckets;
@@ -551,11 +553,33 @@ stumpBinsymKernelPacked(const uint64_t * index_data,
 namespace ML {
 namespace CUDA {
 
+/// Set to true to trace the planning and results of each execution
+static const bool debug = false;
+
+/// Shared memory available to a block for the buckets and the total
+static const int MAX_SHARED_MEM = 16384;
+
 
 /*****************************************************************************/
 /* TEST_BUCKETS_BINSYM                                                       */
 /*****************************************************************************/
 
+bool
+Test_Buckets_Binsym::
+deviceAvailable()
+{
+    int numDevices = 0;
+    cudaError_t err = cudaGetDeviceCount(&numDevices);
+    return err == cudaSuccess && numDevices > 0;
+}
+
+int
+Test_Buckets_Binsym::
+maxDeviceBuckets()
+{
+    return MAX_SHARED_MEM / sizeof(TwoBuckets) - 1;
+}
+
 void executeHost(TwoBuckets * accum,
                  TwoBuckets & w_label,
                  const float * weights,
@@ -600,14 +624,14 @@ struct Test_Buckets_Binsym::Context {
             d_w_label.sync(w_label);
         }
 
-#if 1
-        cerr << "final results: " << endl;
-        for (unsigned i = 0;  i < 2 /*num_buckets*/;  ++i)
-            cerr << "bucket " << i << ": 0: " << accum[i][0]
-                 << "  1: " << accum[i][1] << endl;
-#endif
-        cerr << "w_label: 0: " << w_label[0][0] << " 1: " << w_label[0][1]
-             << endl;
+        if (debug) {
+            cerr << "final results: " << endl;
+            for (unsigned i = 0;  i < 2 /*num_buckets*/;  ++i)
+                cerr << "bucket " << i << ": 0: " << accum[i][0]
+                     << "  1: " << accum[i][1] << endl;
+            cerr << "w_label: 0: " << w_label[0][0] << " 1: " << w_label[0][1]
+                 << endl;
+        }
     }
 };
 
@@ -650,8 +674,10 @@ struct Test_Buckets_Binsym::Plan {
         // How many of these thread blocks?
         grid = dim3( rudiv(size, threads.x * num_todo));
         
-        cerr << "num_todo = " << num_todo << endl;
-        cerr << "grid: x = " << grid.x << endl;
+        if (debug) {
+            cerr << "num_todo = " << num_todo << endl;
+            cerr << "grid: x = " << grid.x << endl;
+        }
         
         // If there aren't enough buckets, then create some more and merge
         // them together at the end.
@@ -664,9 +690,10 @@ struct Test_Buckets_Binsym::Plan {
             buckets_to_allocate = num_buckets * bucket_expansion;
         }
         
-        cerr << "num_buckets = " << num_buckets << " bucket_expansion = "
-             << bucket_expansion << " buckets_to_allocate = "
-             << buckets_to_allocate << endl;
+        if (debug)
+            cerr << "num_buckets = " << num_buckets << " bucket_expansion = "
+                 << bucket_expansion << " buckets_to_allocate = "
+                 << buckets_to_allocate << endl;
 
         // How much shared memory?
         //
@@ -679,7 +706,12 @@ struct Test_Buckets_Binsym::Plan {
         // parallelism.
         shared_mem_size = sizeof(TwoBuckets) * (buckets_to_allocate + 1);
         
-        cerr << "shared_mem_size = " << shared_mem_size << endl;
+        if (debug)
+            cerr << "shared_mem_size = " << shared_mem_size << endl;
+
+        if (shared_mem_size > MAX_SHARED_MEM)
+            throw Exception("Test_Buckets_Binsym: %d buckets is too many "
+                            "to run on the device", num_buckets);
         
         if (compressed) {
             d_compressed_index.init(compressed_index.data.get(),
@@ -748,11 +780,11 @@ struct Test_Buckets_Binsym::Plan {
 
     bool use_texture;
 
-    boost::shared_ptr<Context>
+    std::shared_ptr<Context>
     executeHost(TwoBuckets * accum,
                 TwoBuckets & w_label) const
     {
-        boost::shared_ptr<Context> result(new Context());
+        std::shared_ptr<Context> result(new Context());
         //result->plan = this;
 
         // Get the data structures
@@ -779,11 +811,11 @@ struct Test_Buckets_Binsym::Plan {
         return result;
     }
 
-    boost::shared_ptr<Context>
+    std::shared_ptr<Context>
     executeDevice(TwoBuckets * accum,
                   TwoBuckets & w_label) const
     {
-        boost::shared_ptr<Context> result(new Context());
+        std::shared_ptr<Context> result(new Context());
         //result->plan = this;
 
         // Get the data structures
@@ -821,7 +853,7 @@ struct Test_Buckets_Binsym::Plan {
         return result;
     }
 
-    boost::shared_ptr<Context>
+    std::shared_ptr<Context>
     execute(TwoBuckets * accum,
             TwoBuckets & w_label) const
     {
@@ -836,7 +868,7 @@ struct Test_Buckets_Binsym::Plan {
     }
 };
 
-boost::shared_ptr<Test_Buckets_Binsym::Plan>
+std::shared_ptr<Test_Buckets_Binsym::Plan>
 Test_Buckets_Binsym::
 plan(const uint16_t * buckets,
      const uint32_t * examples, // or 0 if example num == i
@@ -849,12 +881,12 @@ plan(const uint16_t * buckets,
      bool on_device,
      bool compressed) const
 {
-    return boost::shared_ptr<Test_Buckets_Binsym::Plan>
+    return std::shared_ptr<Test_Buckets_Binsym::Plan>
         (new Plan(buckets, examples, labels, divisors, size, weights,
                   ex_weights, num_buckets, on_device, compressed));
 }
 
-boost::shared_ptr<Test_Buckets_Binsym::Context>
+std::shared_ptr<Test_Buckets_Binsym::Context>
 Test_Buckets_Binsym::
 execute(const Plan & plan,
         TwoBuckets * accum,
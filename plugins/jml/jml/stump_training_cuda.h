@@ -12,6 +12,8 @@
 #ifndef __jml__stump_training_cuda_h__
 #define __jml__stump_training_cuda_h__
 
+#include <memory>
+#include <stdint.h>
 #include "fixed_point_accum.h"
 
 namespace ML {
@@ -30,6 +32,14 @@ struct Test_Buckets_Binsym {
     struct Plan;     // Implementation is private
     struct Context;  // implementation is private
 
+    /** Is there a CUDA device that plans can be executed on? */
+    static bool deviceAvailable();
+
+    /** Maximum number of buckets that a plan can have to run on the
+        device, as they need to fit in a block's shared memory.  Plans
+        with more will throw when created. */
+    static int maxDeviceBuckets();
+
     std::shared_ptr<Plan>
     plan(const uint16_t * buckets,
          const uint32_t * examples, // or 0 if example num == i
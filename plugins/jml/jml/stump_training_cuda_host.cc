@@ -10,8 +10,8 @@
 #include "mldb/arch/bit_range_ops.h"
 #include "mldb/arch/tick_counter.h"
 
-typedef MLDB::CUDA::Test_Buckets_Binsym::Float Float;
-typedef MLDB::CUDA::Test_Buckets_Binsym::TwoBuckets TwoBuckets;
+typedef ML::CUDA::Test_Buckets_Binsym::Float Float;
+typedef ML::CUDA::Test_Buckets_Binsym::TwoBuckets TwoBuckets;
 
 namespace ML {
 namespace CUDA {
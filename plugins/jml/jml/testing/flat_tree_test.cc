@@ -0,0 +1,178 @@
+/* flat_tree_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test that the flattened layouts used for optimized prediction of trees
+   and stumps give exactly the same results as the unoptimized predict.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <cmath>
+#include <iostream>
+
+#include "mldb/plugins/jml/jml/decision_tree_generator.h"
+#include "mldb/plugins/jml/jml/committee.h"
+#include "mldb/plugins/jml/jml/boosted_stumps.h"
+#include "mldb/plugins/jml/jml/training_data.h"
+#include "mldb/plugins/jml/jml/dense_features.h"
+#include "mldb/plugins/jml/jml/feature_info.h"
+#include "mldb/utils/smart_ptr_utils.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+struct Dataset {
+    Dataset(int nfv = 2000)
+    {
+        fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+        fs.add_feature("feature1", REAL);
+        fs.add_feature("feature2", REAL);
+        fs.add_feature("feature3", REAL);
+        fs.add_feature("feature4", REAL);
+        fsp = make_unowned_sp(fs);
+        data.reset(new Training_Data(fsp));
+
+        srand(1);
+        for (unsigned i = 0;  i < nfv;  ++i) {
+            distribution<float> features;
+            float x = (rand() % 1000) / 100.0;
+            float y = (rand() % 1000) / 100.0;
+            features.push_back((x > 5) != (y > 3));
+            features.push_back(x);
+            features.push_back(y);
+            features.push_back(rand() % 7);
+            // Missing one time in five, to exercise the missing branches
+            features.push_back(i % 5 == 0 ? NAN : (rand() % 100) / 10.0);
+            dense.push_back(features);
+            data->add_example(fs.encode(features));
+        }
+    }
+
+    std::shared_ptr<Classifier_Impl> train_tree(int max_depth)
+    {
+        Configuration config;
+        config.parse_string(format("max_depth=%d\n", max_depth),
+                            "inbuilt config file");
+
+        Decision_Tree_Generator generator;
+        vector<string> unparsedKeys;
+        generator.configure(config, unparsedKeys);
+        generator.init(fsp, fs.features()[0]);
+
+        distribution<float> weights(data->example_count(), 1);
+        vector<Feature> features = fs.features();
+        features.erase(features.begin());
+
+        Thread_Context context;
+        return generator.generate(context, *data, weights, features);
+    }
+
+    /** Check that the optimized predictions of the classifier, one by one
+        and as a batch, are the same as the unoptimized ones (to within the
+        given tolerance, since some classifiers accumulate in double
+        precision when optimized), and that the batch predictions are
+        exactly the same as the one by one optimized predictions. */
+    void check(Classifier_Impl & classifier, double tolerance = 0.0)
+    {
+        Optimization_Info info = classifier.optimize(fs.features());
+        BOOST_REQUIRE(classifier.predict_is_optimized());
+
+        int nl = classifier.label_count();
+        int nf = fs.features().size();
+        size_t n = dense.size();
+
+        vector<float> batchInput;
+        for (auto & features: dense)
+            batchInput.insert(batchInput.end(),
+                              features.begin(), features.end());
+
+        vector<float> batch(n * nl), batchLabel(n);
+        classifier.predict_batch(batchInput.data(), n, info, batch.data());
+        classifier.predict_batch(1, batchInput.data(), n, info,
+                                 batchLabel.data());
+
+        for (unsigned i = 0;  i < n;  ++i) {
+            Label_Dist expected = classifier.predict(*fs.encode(dense[i]));
+            Label_Dist optimized
+                = classifier.predict(&batchInput[i * nf], info);
+            BOOST_REQUIRE_EQUAL(expected.size(), nl);
+            BOOST_REQUIRE_EQUAL(optimized.size(), nl);
+            float optimizedLabel
+                = classifier.predict(1, &batchInput[i * nf], info);
+            for (unsigned j = 0;  j < nl;  ++j) {
+                if (tolerance == 0.0)
+                    BOOST_CHECK_EQUAL(optimized[j], expected[j]);
+                else BOOST_CHECK_SMALL(optimized[j] - expected[j], (float)tolerance);
+                BOOST_CHECK_EQUAL(batch[i * nl + j], optimized[j]);
+            }
+            BOOST_CHECK_EQUAL(optimizedLabel, optimized[1]);
+            BOOST_CHECK_EQUAL(batchLabel[i], optimized[1]);
+        }
+    }
+
+    Dense_Feature_Space fs;
+    std::shared_ptr<Dense_Feature_Space> fsp;
+    std::shared_ptr<Training_Data> data;
+    vector<distribution<float> > dense;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_flat_decision_tree )
+{
+    Dataset dataset;
+    for (int depth: { 1, 3, 8 }) {
+        std::shared_ptr<Classifier_Impl> tree = dataset.train_tree(depth);
+        dataset.check(*tree);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_flat_committee )
+{
+    Dataset dataset;
+    Committee committee(dataset.fsp, dataset.fs.features()[0]);
+    committee.add(dataset.train_tree(2), 0.5);
+    committee.add(dataset.train_tree(4), 0.25);
+    committee.add(dataset.train_tree(6), 0.125);
+    committee.bias[0] = 0.1;
+    committee.bias[1] = -0.2;
+
+    dataset.check(committee, 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE( test_flat_boosted_stumps )
+{
+    Dataset dataset;
+    const vector<Feature> & features = dataset.fs.features();
+
+    for (auto output: { Boosted_Stumps::RAW, Boosted_Stumps::LOGIT,
+                Boosted_Stumps::LOGIT_NORM }) {
+        Boosted_Stumps stumps(dataset.fsp, features[0]);
+        stumps.output = output;
+        stumps.bias = { 0.1, -0.1 };
+
+        for (unsigned i = 1;  i < features.size();  ++i) {
+            for (float arg: { 2.0, 5.0 }) {
+                Stump stump(features[0], features[i], arg,
+                            { 0.1f * i, -0.2f }, { -0.3f, 0.4f * i },
+                            { 0.05f, 0.0f }, Stump::NORMAL, dataset.fsp);
+                stumps.insert(stump);
+            }
+        }
+
+        dataset.check(stumps);
+
+        // Inserting another stump makes it unoptimized again
+        stumps.insert(Stump(features[0], features[1], 7.0,
+                            { 1.0, 0.0 }, { 0.0, 1.0 }, { 0.5, 0.5 },
+                            Stump::NORMAL, dataset.fsp));
+        BOOST_CHECK(!stumps.predict_is_optimized());
+        dataset.check(stumps);
+    }
+}
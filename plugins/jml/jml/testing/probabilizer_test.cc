@@ -124,3 +124,42 @@ BOOST_AUTO_TEST_CASE( test_probabilizer_single_dof_mode2 )
     BOOST_CHECK_GT(true_probs.mean(), 0.20);
     BOOST_CHECK_LT(false_probs.mean(), 0.20);
 }
+
+BOOST_AUTO_TEST_CASE( test_probabilizer_table )
+{
+    for (auto link: { LOGIT, PROBIT, COMP_LOG_LOG, LINEAR, LOG }) {
+        GLZ_Probabilizer prob;
+        prob.link = link;
+        prob.params.resize(1);
+        prob.params[0] = { 3.5, -1.25 };
+
+        Probabilizer_Table table(prob);
+
+        vector<float> scores;
+        for (float score = -10.0;  score <= 10.0;  score += 0.001)
+            scores.push_back(score);
+
+        vector<float> batch(scores.size());
+        table.apply(scores.data(), batch.data(), scores.size());
+
+        double maxError = 0.0;
+        for (unsigned i = 0;  i < scores.size();  ++i) {
+            float expected = prob.apply(distribution<float>(1, scores[i]))[0];
+            float single = table.apply(scores[i]);
+            BOOST_CHECK_EQUAL(single, batch[i]);
+            maxError = std::max<double>(maxError, fabs(single - expected));
+
+            // Monotone like the link function
+            if (i > 0)
+                BOOST_CHECK_GE(batch[i], batch[i - 1]);
+        }
+
+        cerr << "link " << link << " max error " << maxError << endl;
+        BOOST_CHECK_LT(maxError, 1e-6);
+    }
+
+    // Only single output probabilizers can be compiled
+    GLZ_Probabilizer multi;
+    multi.params.resize(2, distribution<float>(3));
+    BOOST_CHECK_THROW(Probabilizer_Table table(multi), std::exception);
+}
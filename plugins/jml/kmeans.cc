@@ -15,6 +15,25 @@
 namespace ML {
 namespace DB = MLDB::DB;
 
+namespace {
+
+// Unfortunately, std::atomic can't be copied or moved, so we need
+// a wrapper to put it in a vector
+struct AI: public std::atomic<int> {
+    AI(int n = 0)
+        : std::atomic<int>(n)
+    {
+    }
+
+    AI & operator = (const AI & other) noexcept
+    {
+        store(other.load());
+        return *this;
+    }
+};
+
+} // file scope
+
 void
 KMeans::
 train(const std::vector<distribution<float>> & points,
@@ -36,6 +55,31 @@ train(const std::vector<distribution<float>> & points,
 
     int npoints = points.size();
     in_cluster.resize(npoints, -1);
+
+    initializeCentroids(points, nbClusters, rng);
+
+    switch (algorithm) {
+    case LLOYD:
+        trainLloyd(points, in_cluster, maxIterations);
+        break;
+    case HAMERLY:
+        trainHamerly(points, in_cluster, maxIterations);
+        break;
+    case MINI_BATCH:
+        trainMiniBatch(points, in_cluster, maxIterations, rng);
+        break;
+    default:
+        throw MLDB::Exception("unknown kmeans algorithm");
+    }
+}
+
+void
+KMeans::
+initializeCentroids(const std::vector<distribution<float>> & points,
+                    int nbClusters, std::mt19937 & rng)
+{
+    using namespace std;
+
     clusters.resize(nbClusters);
 
     // Smart initialization of the centroids
@@ -79,7 +123,43 @@ train(const std::vector<distribution<float>> & points,
         clusters[i].centroid = points[bestPoint];
         // cerr << "norm of best init centroid " << clusters[i].centroid.two_norm() << endl;
     }
+}
+
+void
+KMeans::
+updateCentroids(const std::vector<distribution<float>> & points,
+                const std::vector<int> & in_cluster)
+{
+    // Calculate means
+    for (auto & c : clusters)
+        // If no member, we want to leave it there
+        if (c.nbMembers > 0)
+            std::fill(c.centroid.begin(), c.centroid.end(), 0.0);
+
+    std::vector<std::mutex> locks(clusters.size());
+
+    auto addToMeanForPoint = [&] (int i) {
+        int cluster = in_cluster[i];
+        auto & point = points[i];
+
+        {
+            std::unique_lock<std::mutex> guard(locks[cluster]);
+            metric->contributeToAverage(clusters[cluster].centroid, point, 1. / (double) clusters[cluster].nbMembers);
+        }
+    };
+
+    MLDB::parallelMap(0, points.size(), addToMeanForPoint);
+}
+
+void
+KMeans::
+trainLloyd(const std::vector<distribution<float>> & points,
+           std::vector<int> & in_cluster,
+           int maxIterations)
+{
+    using namespace std;
 
+    int nbClusters = clusters.size();
 
     for (int iter = 0;  iter < maxIterations;  ++iter) {
 
@@ -87,21 +167,6 @@ train(const std::vector<distribution<float>> & points,
         // contents are stable
         std::atomic<int> changes(0);
 
-        // Unfortunately, std::atomic can't be copied or moved, so we need
-        // a wrapper to put it in a vector
-        struct AI: public std::atomic<int> {
-            AI(int n = 0)
-                : std::atomic<int>(n)
-            {
-            }
-
-            AI & operator = (const AI & other) noexcept
-            {
-                store(other.load());
-                return *this;
-            }
-        };
-
         std::vector<AI> clusterNumMembers(nbClusters);
 
         auto findNewCluster = [&] (int i) {
@@ -122,6 +187,7 @@ train(const std::vector<distribution<float>> & points,
             clusters[i].nbMembers = clusterNumMembers[i];
 
 #if KMEANS_DEBUG
+        int npoints = points.size();
         auto printDebug = [&] (const string & step, int iter) {
             filter_ostream stream(MLDB::format("kmeans_debug_%i_%s.csv", iter, step));
             stream << "x,y,group,type\n";
@@ -142,27 +208,7 @@ train(const std::vector<distribution<float>> & points,
 
         // std::cerr << "\niter " << iter << std::endl;
 
-        // Calculate means
-        for (auto & c : clusters)
-            // If no member, we want to leave it there
-            if (c.nbMembers > 0)
-                std::fill(c.centroid.begin(), c.centroid.end(), 0.0);
-
-        std::vector<std::mutex> locks(clusters.size());
-
-        auto addToMeanForPoint = [&] (int i) {
-            int cluster = in_cluster[i];
-            auto point = points[i];
-
-            {
-                // cerr << "cluster du point i " << cluster << endl;
-                std::unique_lock<std::mutex> guard(locks[cluster]);
-                // cerr << "patate pour mich" << endl;
-                metric->contributeToAverage(clusters[cluster].centroid, point, 1. / (double) clusters[cluster].nbMembers);
-            }
-        };
-
-        MLDB::parallelMap(0, points.size(), addToMeanForPoint);
+        updateCentroids(points, in_cluster);
 
         // for (int i=0; i < clusters.size(); ++i) {
             // cerr << "cluster " << i << " had " << clusters[i].nbMembers
@@ -192,6 +238,220 @@ train(const std::vector<distribution<float>> & points,
     }
 }
 
+/* Hamerly's algorithm ("Making k-means even faster", SDM 2010).  Each point
+   keeps an upper bound on the distance to its own centroid, and a lower
+   bound on the distance to every other one.  When the centroids move, the
+   bounds are loosened by how far they moved.  A point can only change
+   cluster if its upper bound is more than its lower bound and than half of
+   the distance from its centroid to the closest other one; only those
+   points have their distances calculated.  The assignments are the same
+   as LLOYD's.
+*/
+void
+KMeans::
+trainHamerly(const std::vector<distribution<float>> & points,
+             std::vector<int> & in_cluster,
+             int maxIterations)
+{
+    using namespace std;
+
+    if (!metric->isMetric())
+        throw MLDB::Exception("the Hamerly kmeans algorithm requires a "
+                              "distance that satisfies the triangle "
+                              "inequality, such as the euclidean metric");
+
+    int nbClusters = clusters.size();
+    size_t npoints = points.size();
+
+    std::vector<double> upper(npoints), lower(npoints);
+    std::vector<double> halfClosest(nbClusters), moved(nbClusters);
+
+    for (int iter = 0;  iter < maxIterations;  ++iter) {
+
+        std::atomic<int> changes(0);
+        std::atomic<size_t> numCalculated(0);
+        std::vector<AI> clusterNumMembers(nbClusters);
+
+        // Half the distance from each centroid to the closest other one
+        auto doHalfClosest = [&] (int j)
+            {
+                double closest = INFINITY;
+                for (int j2 = 0;  j2 < nbClusters;  ++j2) {
+                    if (j2 == j)
+                        continue;
+                    closest = std::min(closest,
+                                       metric->distance(clusters[j].centroid,
+                                                        clusters[j2].centroid));
+                }
+                halfClosest[j] = closest / 2;
+            };
+
+        if (iter > 0)
+            MLDB::parallelMap(0, nbClusters, doHalfClosest);
+
+        auto findNewCluster = [&] (size_t i)
+            {
+                int cluster = in_cluster[i];
+
+                if (iter > 0 && cluster != -1) {
+                    double bound = std::max(halfClosest[cluster], lower[i]);
+                    if (upper[i] <= bound) {
+                        ++clusterNumMembers[cluster];
+                        return;
+                    }
+
+                    // Tighten the upper bound and try again
+                    upper[i] = metric->distance(points[i],
+                                                clusters[cluster].centroid);
+                    if (upper[i] <= bound) {
+                        ++clusterNumMembers[cluster];
+                        return;
+                    }
+                }
+
+                // Find the closest two, as assign() does
+                double best = INFINITY, second = INFINITY;
+                int bestCluster = -1;
+                for (int j = 0;  j < nbClusters;  ++j) {
+                    double dist = metric->distance(points[i],
+                                                   clusters[j].centroid);
+                    if (dist < best) {
+                        second = best;
+                        best = dist;
+                        bestCluster = j;
+                    }
+                    else if (dist < second)
+                        second = dist;
+                }
+                numCalculated += nbClusters;
+
+                // Those are points with infinite or nan distance; put them
+                // in cluster 0 and always recalculate them
+                if (bestCluster == -1) {
+                    bestCluster = 0;
+                    best = INFINITY;
+                    second = -INFINITY;
+                }
+
+                upper[i] = best;
+                lower[i] = second;
+
+                if (bestCluster != cluster) {
+                    ++changes;
+                    in_cluster[i] = bestCluster;
+                }
+
+                ++clusterNumMembers[bestCluster];
+            };
+
+        MLDB::parallelMap(0, npoints, findNewCluster);
+
+        for (unsigned i = 0;  i < nbClusters;  ++i)
+            clusters[i].nbMembers = clusterNumMembers[i];
+
+        std::vector<distribution<float> > oldCentroids;
+        for (auto & c: clusters)
+            oldCentroids.push_back(c.centroid);
+
+        updateCentroids(points, in_cluster);
+
+        cerr << "done clustering iter " << iter
+             << ": " << changes << " changes, "
+             << numCalculated << " full distance calculations" << endl;
+
+        if (changes == 0)
+            break;
+
+        // Loosen the bounds by how far the centroids moved.  The lower
+        // bound is for all of the other centroids, so we need to take the
+        // largest move apart from that of the point's own centroid.
+        int mostMoved = 0;
+        for (int j = 0;  j < nbClusters;  ++j) {
+            moved[j] = metric->distance(oldCentroids[j], clusters[j].centroid);
+            if (moved[j] > moved[mostMoved])
+                mostMoved = j;
+        }
+        double secondMoved = 0.0;
+        for (int j = 0;  j < nbClusters;  ++j) {
+            if (j != mostMoved)
+                secondMoved = std::max(secondMoved, moved[j]);
+        }
+
+        auto loosenBounds = [&] (size_t i)
+            {
+                int cluster = in_cluster[i];
+                upper[i] += moved[cluster];
+                lower[i] -= cluster == mostMoved ? secondMoved
+                    : moved[mostMoved];
+            };
+
+        MLDB::parallelMap(0, npoints, loosenBounds);
+
+        for (auto & c : clusters)
+            c.nbMembers = 0;
+    }
+}
+
+/* Mini-batch k-means (Sculley, "Web-scale k-means clustering", WWW 2010).
+   Each iteration takes batchSize random points, and moves the centroid
+   each is closest to towards it, with a learning rate of one over the
+   number of points that centroid has seen so far.  Once done, all of the
+   points are assigned to their closest centroid.
+*/
+void
+KMeans::
+trainMiniBatch(const std::vector<distribution<float>> & points,
+               std::vector<int> & in_cluster,
+               int maxIterations, std::mt19937 & rng)
+{
+    using namespace std;
+
+    if (batchSize < 1)
+        throw MLDB::Exception("kmeans mini-batch size must be at least 1");
+
+    int nbClusters = clusters.size();
+    size_t npoints = points.size();
+
+    std::vector<size_t> seen(nbClusters);
+    std::vector<int> batch(batchSize), batchCluster(batchSize);
+
+    for (int iter = 0;  iter < maxIterations;  ++iter) {
+        for (auto & i: batch)
+            i = rng() % npoints;
+
+        // Assign against the centroids from the start of the batch
+        auto assignBatch = [&] (int j)
+            {
+                batchCluster[j] = this->assign(points[batch[j]]);
+            };
+
+        MLDB::parallelMap(0, batchSize, assignBatch);
+
+        for (int j = 0;  j < batchSize;  ++j) {
+            auto & centroid = clusters[batchCluster[j]].centroid;
+            double rate = 1.0 / ++seen[batchCluster[j]];
+            centroid *= 1.0 - rate;
+            metric->contributeToAverage(centroid, points[batch[j]], rate);
+        }
+    }
+
+    std::vector<AI> clusterNumMembers(nbClusters);
+
+    auto findCluster = [&] (size_t i)
+        {
+            in_cluster[i] = this->assign(points[i]);
+            ++clusterNumMembers[in_cluster[i]];
+        };
+
+    MLDB::parallelMap(0, npoints, findCluster);
+
+    for (unsigned i = 0;  i < nbClusters;  ++i)
+        clusters[i].nbMembers = clusterNumMembers[i];
+
+    cerr << "done mini-batch clustering with " << maxIterations
+         << " batches of " << batchSize << endl;
+}
+
 distribution<float>
 KMeans::
 centroidDistances(const distribution<float> & point) const
@@ -211,12 +471,12 @@ assign(const distribution<float> & point) const
     if (clusters.size() == 0)
         throw MLDB::Exception("Did you train your kmeans?");
 
-    float distMin = INFINITY;
+    double distMin = INFINITY;
     int best_cluster = -1;
-    auto distances = centroidDistances(point);
     for (int i=0; i < clusters.size(); ++i) {
-        if (distances[i] < distMin) {
-            distMin = distances[i];
+        double dist = metric->distance(point, clusters[i].centroid);
+        if (dist < distMin) {
+            distMin = dist;
             best_cluster = i;
         }
     }
@@ -9,10 +9,13 @@
 
 #include <vector>
 #include <mutex>
+#include <random>
 #include "mldb/utils/distribution.h"
 #include "mldb/types/db/persistent.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/base/parallel.h"
+#include "mldb/arch/simd_vector.h"
+#include "mldb/base/exc_assert.h"
 #include <boost/math/special_functions/fpclassify.hpp>
 
 
@@ -47,13 +50,20 @@ public:
 
     // For serialization
     virtual std::string tag() const = 0;
+
+    // Does the distance satisfy the triangle inequality?  Accelerated
+    // algorithms that prune using distance bounds require it.
+    virtual bool isMetric() const { return false; }
 };
 
 class KMeansEuclideanMetric : public KMeansMetric {
 public:
     double distance(const distribution<float> & x,
                     const distribution<float> & y) const
-    { return (x - y).two_norm(); }
+    {
+        ExcAssertEqual(x.size(), y.size());
+        return sqrt(MLDB::SIMD::vec_euclid(x.data(), y.data(), x.size()));
+    }
 
     distribution<float>
     average(const std::vector<distribution<float>> & points) const
@@ -74,6 +84,8 @@ public:
     }
 
     std::string tag() const { return "EuclideanMetric"; }
+
+    bool isMetric() const { return true; }
 };
 
 /*
@@ -141,6 +153,15 @@ struct KMeans {
     {
     }
 
+    /// Algorithm used by train()
+    enum Algorithm {
+        LLOYD,       ///< Compute all point to centroid distances each iteration
+        HAMERLY,     ///< Same result as LLOYD, but uses bounds on the
+                     ///< distances to skip most of them.  Needs a metric.
+        MINI_BATCH   ///< Approximate; move the centroids towards a random
+                     ///< mini-batch of the points each iteration
+    };
+
     struct Cluster {
         int nbMembers;
         distribution<float> centroid;
@@ -148,6 +169,11 @@ struct KMeans {
 
     std::vector<Cluster> clusters;
     std::shared_ptr<KMeansMetric> metric;
+
+    Algorithm algorithm = LLOYD;
+
+    /// Number of points in each iteration of MINI_BATCH
+    int batchSize = 1000;
     
     void train(const std::vector<distribution<float> > & points,
                std::vector<int> & in_cluster,
@@ -164,6 +190,26 @@ struct KMeans {
     void reconstitute(MLDB::DB::Store_Reader & store);
     void save(const std::string & filename) const;
     void load(const std::string & filename);
+
+private:
+    void initializeCentroids(const std::vector<distribution<float> > & points,
+                             int nbClusters, std::mt19937 & rng);
+
+    // Set each centroid with members to the average of its members
+    void updateCentroids(const std::vector<distribution<float> > & points,
+                         const std::vector<int> & in_cluster);
+
+    void trainLloyd(const std::vector<distribution<float> > & points,
+                    std::vector<int> & in_cluster,
+                    int maxIterations);
+
+    void trainHamerly(const std::vector<distribution<float> > & points,
+                      std::vector<int> & in_cluster,
+                      int maxIterations);
+
+    void trainMiniBatch(const std::vector<distribution<float> > & points,
+                        std::vector<int> & in_cluster,
+                        int maxIterations, std::mt19937 & rng);
 };
 
 } // namespace ML
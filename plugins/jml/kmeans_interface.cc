@@ -26,6 +26,7 @@
 #include "mldb/engine/analytics.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/optional_description.h"
+#include "mldb/types/enum_description.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/filter_streams.h"
 
@@ -33,6 +34,25 @@ using namespace std;
 
 
 
+namespace ML {
+
+DEFINE_ENUM_DESCRIPTION_NAMED(KMeansAlgorithmDescription, KMeans::Algorithm);
+
+KMeansAlgorithmDescription::
+KMeansAlgorithmDescription()
+{
+    addValue("lloyd", KMeans::LLOYD,
+             "Calculate all point to centroid distances on each iteration");
+    addValue("hamerly", KMeans::HAMERLY,
+             "Same clusters as lloyd, skipping distance calculations that "
+             "can't change the result (euclidean metric only)");
+    addValue("minibatch", KMeans::MINI_BATCH,
+             "Approximate clusters from random mini-batches of the rows");
+}
+
+} // namespace ML
+
+
 namespace MLDB {
 
 DEFINE_STRUCTURE_DESCRIPTION(KmeansConfig);
@@ -79,6 +99,19 @@ KmeansConfigDescription()
              "Normally this will be Cosine for an orthonormal basis, and "
              "Euclidian for another basis",
              METRIC_COSINE);
+    addField("algorithm", &KmeansConfig::algorithm,
+             "Algorithm used to find the clusters.  `lloyd` calculates the "
+             "distance from every point to every centroid on each iteration. "
+             "`hamerly` gives the same clusters as `lloyd`, but keeps bounds "
+             "on the distances that allow it to skip most of them once the "
+             "centroids start to settle; it requires the `euclidean` metric. "
+             "`minibatch` is approximate, and moves the centroids towards "
+             "`batchSize` randomly sampled rows on each of `maxIterations` "
+             "iterations, which is much faster on very large inputs.",
+             ML::KMeans::LLOYD);
+    addField("batchSize", &KmeansConfig::batchSize,
+             "Number of rows sampled on each iteration of the `minibatch` "
+             "algorithm.  Ignored by the other algorithms.", 1000);
     addField("modelFileUrl", &KmeansConfig::modelFileUrl,
              "URL where the model file (with extension '.kms') should be saved. "
              "This file can be loaded by the ![](%%doclink kmeans function). "
@@ -89,14 +122,27 @@ KmeansConfigDescription()
              "also be provided.");
     addParent<ProcedureConfig>();
 
+    std::function<void (KmeansConfig *, JsonParsingContext &)>
+        validateAlgorithm = [] (KmeansConfig * config,
+                                JsonParsingContext & context)
+        {
+            if (config->algorithm == ML::KMeans::HAMERLY
+                && config->metric != METRIC_EUCLIDEAN)
+                throw AnnotatedException
+                    (400, "The kmeans.train `hamerly` algorithm requires "
+                     "the `euclidean` metric");
+            if (config->batchSize < 1)
+                throw AnnotatedException
+                    (400, "The kmeans.train `batchSize` must be at least 1");
+        };
+
     onPostValidate = chain(validateQuery(&KmeansConfig::trainingData,
                                          MustContainFrom(),
                                          NoGroupByHaving()),
-                           validateFunction<KmeansConfig>());
+                           chain(validateFunction<KmeansConfig>(),
+                                 validateAlgorithm));
 }
 
-// TODO: see http://www.eecs.tufts.edu/~dsculley/papers/fastkmeans.pdf
-
 namespace {
 
 ML::KMeansMetric * makeMetric(MetricSpace metric)
@@ -192,6 +238,8 @@ run(const ProcedureRunConfig & run,
 
     ML::KMeans kmeans;
     kmeans.metric.reset(makeMetric(runProcConf.metric));
+    kmeans.algorithm = runProcConf.algorithm;
+    kmeans.batchSize = runProcConf.batchSize;
 
     vector<int> inCluster;
 
@@ -17,6 +17,14 @@
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/types/optional.h"
 #include "builtin/metric_space.h"
+#include "mldb/plugins/jml/kmeans.h"
+
+
+namespace ML {
+
+DECLARE_ENUM_DESCRIPTION_NAMED(KMeansAlgorithmDescription, KMeans::Algorithm);
+
+} // namespace ML
 
 
 namespace MLDB {
@@ -33,7 +41,9 @@ struct KmeansConfig : public ProcedureConfig {
         : numInputDimensions(-1),
           numClusters(10),
           maxIterations(100),
-          metric(METRIC_COSINE)
+          metric(METRIC_COSINE),
+          algorithm(ML::KMeans::LLOYD),
+          batchSize(1000)
     {
     }
 
@@ -47,6 +57,8 @@ struct KmeansConfig : public ProcedureConfig {
     int numClusters;
     int maxIterations;
     MetricSpace metric;
+    ML::KMeans::Algorithm algorithm;
+    int batchSize;
 
     Utf8String functionName;
 };
@@ -135,6 +135,25 @@ struct Dense_Layer : public Layer {
           double * temp_space, size_t temp_space_size,
           double * outputs) const;
 
+    /** Forward propagate a batch with a single matrix multiply.  Batches
+        with missing values, or whose precision doesn't match that of the
+        layer, are done one example at a time.
+    */
+    virtual void
+    fprop_batch(size_t n, const float * inputs,
+                float * temp_space, size_t temp_space_size,
+                float * outputs) const;
+
+    virtual void
+    fprop_batch(size_t n, const double * inputs,
+                double * temp_space, size_t temp_space_size,
+                double * outputs) const;
+
+    template<typename F>
+    void fprop_batch(size_t n, const F * inputs,
+                     F * temp_space, size_t temp_space_size,
+                     F * outputs) const;
+
 
     /*************************************************************************/
     /* BPROP                                                                 */
@@ -167,6 +186,43 @@ struct Dense_Layer : public Layer {
                Parameters & gradient,
                double example_weight) const;
 
+    /** Back propagate a batch with a matrix multiply for the input
+        errors and another for the weight gradient.  Same restrictions as
+        fprop_batch().
+    */
+    virtual void bprop_batch(size_t n,
+                             const float * inputs,
+                             const float * outputs,
+                             const float * temp_space, size_t temp_space_size,
+                             const float * output_errors,
+                             float * input_errors,
+                             Parameters & gradient,
+                             const double * example_weights) const;
+
+    virtual void bprop_batch(size_t n,
+                             const double * inputs,
+                             const double * outputs,
+                             const double * temp_space, size_t temp_space_size,
+                             const double * output_errors,
+                             double * input_errors,
+                             Parameters & gradient,
+                             const double * example_weights) const;
+
+    template<typename F>
+    void bprop_batch(size_t n,
+                     const F * inputs,
+                     const F * outputs,
+                     const F * temp_space, size_t temp_space_size,
+                     const F * output_errors,
+                     F * input_errors,
+                     Parameters & gradient,
+                     const double * example_weights) const;
+
+    /** Can the batch be done with matrix multiplies?  That requires the
+        same precision as the layer and no missing values. */
+    template<typename F>
+    bool can_batch(size_t n, const F * inputs) const;
+
     using Layer::bbprop;
 
     virtual void bbprop(const float * inputs,
@@ -13,12 +13,14 @@
 #include "mldb/types/db/persistent.h"
 #include "mldb/arch/demangle.h"
 #include "mldb/plugins/jml/algebra/matrix_ops.h"
+#include "mldb/plugins/jml/algebra/lapack.h"
 #include "mldb/arch/simd_vector.h"
 #include "mldb/utils/string_functions.h"
 #include "mldb/plugins/jml/jml/registry.h"
 #include "mldb/plugins/jml/multi_array_utils.h"
 #include "mldb/utils/distribution_ops.h"
 #include "mldb/utils/distribution_simd.h"
+#include <type_traits>
 
 
 namespace ML {
@@ -493,6 +495,170 @@ bprop(const double * inputs,
                   input_errors, gradient, example_weight);
 }
 
+template<typename Float>
+template<typename F>
+bool
+Dense_Layer<Float>::
+can_batch(size_t n, const F * inputs) const
+{
+    if (!std::is_same<F, Float>::value || this->inputs() == 0)
+        return false;
+    
+    for (size_t i = 0, ni = n * this->inputs();  i < ni;  ++i)
+        if (std::isnan(inputs[i]))
+            return false;
+
+    return true;
+}
+
+template<typename Float>
+template<typename F>
+void
+Dense_Layer<Float>::
+fprop_batch(size_t n, const F * inputs,
+            F * temp_space, size_t temp_space_size,
+            F * outputs) const
+{
+    if (temp_space_size != 0)
+        throw Exception("Dense_Layer::fprop_batch(): wrong temp space size");
+
+    if (!can_batch(n, inputs)) {
+        Layer::fprop_batch(n, inputs, temp_space, temp_space_size, outputs);
+        return;
+    }
+
+    int ni = this->inputs(), no = this->outputs();
+
+    for (size_t x = 0;  x < n;  ++x)
+        std::copy(bias.begin(), bias.end(), outputs + x * no);
+
+    // outputs (n x no) += inputs (n x ni) * weights (ni x no), all row
+    // major, which is the transpose of the same thing in column major
+    const F * w = reinterpret_cast<const F *>(weights.data());
+    LAPack::gemm('N', 'N', no, n, ni, 1.0, w, no, inputs, ni,
+                 1.0, outputs, no);
+
+    for (size_t x = 0;  x < n;  ++x)
+        transfer_function->transfer(outputs + x * no, outputs + x * no, no);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+fprop_batch(size_t n, const float * inputs,
+            float * temp_space, size_t temp_space_size,
+            float * outputs) const
+{
+    fprop_batch<float>(n, inputs, temp_space, temp_space_size, outputs);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+fprop_batch(size_t n, const double * inputs,
+            double * temp_space, size_t temp_space_size,
+            double * outputs) const
+{
+    fprop_batch<double>(n, inputs, temp_space, temp_space_size, outputs);
+}
+
+template<typename Float>
+template<typename F>
+void
+Dense_Layer<Float>::
+bprop_batch(size_t n,
+            const F * inputs,
+            const F * outputs,
+            const F * temp_space, size_t temp_space_size,
+            const F * output_errors,
+            F * input_errors,
+            Parameters & gradient,
+            const double * example_weights) const
+{
+    if (temp_space_size != 0)
+        throw Exception("Dense_Layer::bprop_batch(): wrong temp space size");
+
+    if (!can_batch(n, inputs)) {
+        Layer::bprop_batch(n, inputs, outputs, temp_space, temp_space_size,
+                           output_errors, input_errors, gradient,
+                           example_weights);
+        return;
+    }
+
+    int ni = this->inputs(), no = this->outputs();
+
+    // Derivative of the error with respect to each activation
+    std::vector<F> dact(n * no);
+    for (size_t x = 0;  x < n;  ++x) {
+        F * d = &dact[x * no];
+        transfer_function->derivative(outputs + x * no, d, no);
+        SIMD::vec_prod(d, output_errors + x * no, d, no);
+    }
+
+    const F * w = reinterpret_cast<const F *>(weights.data());
+
+    // input_errors (n x ni) = dact (n x no) * transpose(weights)
+    if (input_errors)
+        LAPack::gemm('T', 'N', ni, n, no, 1.0, w, no, &dact[0], no,
+                     0.0, input_errors, ni);
+
+    // From here on the derivatives are weighted by example
+    distribution<double> dbias(no);
+    for (size_t x = 0;  x < n;  ++x) {
+        F * d = &dact[x * no];
+        F k = example_weights[x];
+        for (unsigned o = 0;  o < no;  ++o) {
+            d[o] *= k;
+            dbias[o] += d[o];
+        }
+    }
+
+    gradient.vector(1, "bias").update(&dbias[0], 1.0);
+
+    // dweights (ni x no) = transpose(inputs) * dact
+    std::vector<F> dweights(ni * no);
+    LAPack::gemm('N', 'T', no, ni, n, 1.0, &dact[0], no, inputs, ni,
+                 0.0, &dweights[0], no);
+
+    Matrix_Parameter & gweights = gradient.matrix(0, "weights");
+    for (unsigned i = 0;  i < ni;  ++i)
+        gweights.update_row(i, &dweights[i * no], 1.0);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+bprop_batch(size_t n,
+            const float * inputs,
+            const float * outputs,
+            const float * temp_space, size_t temp_space_size,
+            const float * output_errors,
+            float * input_errors,
+            Parameters & gradient,
+            const double * example_weights) const
+{
+    bprop_batch<float>(n, inputs, outputs, temp_space, temp_space_size,
+                       output_errors, input_errors, gradient,
+                       example_weights);
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+bprop_batch(size_t n,
+            const double * inputs,
+            const double * outputs,
+            const double * temp_space, size_t temp_space_size,
+            const double * output_errors,
+            double * input_errors,
+            Parameters & gradient,
+            const double * example_weights) const
+{
+    bprop_batch<double>(n, inputs, outputs, temp_space, temp_space_size,
+                        output_errors, input_errors, gradient,
+                        example_weights);
+}
+
 namespace {
 
 template<typename F>
@@ -122,6 +122,76 @@ train_example(const float * data,
     return make_pair(sqrt(error), outputs[0]);
 }
 
+double
+Discriminative_Trainer::
+train_examples(const std::vector<const float *> & data,
+               const std::vector<Label> & labels,
+               const std::vector<float> & weights,
+               const Output_Encoder & encoder,
+               const std::vector<int> & examples,
+               int first, int last,
+               Parameters_Copy<double> & updates,
+               std::vector<float> & outputs) const
+{
+    int ni = layer->inputs(), no = layer->outputs();
+    size_t temp_space_required = layer->fprop_temporary_space_required();
+    int nb = std::min(examples_per_batch, last - first);
+
+    distribution<float> inputs(nb * ni);
+    distribution<float> batch_outputs(nb * no);
+    distribution<float> derrors(nb * no);
+    distribution<float> temp_space(nb * temp_space_required);
+    vector<double> batch_weights(nb);
+
+    double total_rmse = 0.0;
+
+    for (int b = first;  b < last;  b += nb) {
+        int n = std::min(nb, last - b);
+
+        for (int i = 0;  i < n;  ++i) {
+            const float * in = data[examples[b + i]];
+            std::copy(in, in + ni, &inputs[i * ni]);
+        }
+
+        /* fprop */
+        layer->fprop_batch(n, &inputs[0], &temp_space[0],
+                           n * temp_space_required, &batch_outputs[0]);
+
+        /* error */
+        bool any_weight = false;
+        for (int i = 0;  i < n;  ++i) {
+            int x = examples[b + i];
+            distribution<float> label = encoder.target(labels[x]);
+            const float * out = &batch_outputs[i * no];
+            float * d = &derrors[i * no];
+
+            double error = 0.0;
+            for (unsigned o = 0;  o < no;  ++o) {
+                float e = label[o] - out[o];
+                error += e * e;
+                // TODO: get the loss function to do this...
+                d[o] = -2.0 * e;
+            }
+
+            batch_weights[i] = weights.empty() ? 1.0 : weights.at(x);
+            any_weight = any_weight || batch_weights[i] != 0.0;
+
+            outputs[b + i] = out[0];
+            total_rmse += sqrt(error);
+        }
+
+        /* bprop */
+        if (any_weight)
+            layer->bprop_batch(n, &inputs[0], &batch_outputs[0],
+                               &temp_space[0], n * temp_space_required,
+                               &derrors[0],
+                               0 /* don't calculate input errors */,
+                               updates, &batch_weights[0]);
+    }
+
+    return total_rmse;
+}
+
 namespace {
 
 struct Train_Examples_Job {
@@ -170,32 +240,12 @@ struct Train_Examples_Job {
         Parameters_Copy<double> local_updates(*trainer.layer);
         local_updates.fill(0.0);
 
-        double total_rmse_local = 0.0;
-
         //cerr << "training from " << first << " to " << last << endl;
 
-        for (unsigned ix = first; ix < last;  ++ix) {
-            int x = examples[ix];
-
-            double rmse_contribution;
-            double output;
-
-            float weight = 1.0;
-            if (weights.size())
-                weight = weights.at(x);
-
-            //cerr << "x " << x << " weight " << weight << endl;
-
-            std::tie(rmse_contribution, output)
-                = trainer.train_example(data[x],
-                                        labels[x],
-                                        local_updates,
-                                        output_encoder,
-                                        weight);
-            
-            outputs[ix] = output;
-            total_rmse_local += rmse_contribution;
-        }
+        double total_rmse_local
+            = trainer.train_examples(data, labels, weights, output_encoder,
+                                     examples, first, last, local_updates,
+                                     outputs);
 
         Guard guard(updates_lock);
         total_rmse += total_rmse_local;
@@ -243,7 +293,11 @@ train_iter(const std::vector<const float *> & data,
 {
     int nx = data.size();
 
-    int microbatch_size = std::max(minibatch_size / (MLDB::numCpus() * 4), 1);
+    // Each thread accumulates the gradient of its examples separately, and
+    // needs enough of them to make the matrix multiplies worthwhile
+    int microbatch_size
+        = std::max(minibatch_size / (MLDB::numCpus() * 4),
+                   std::min(minibatch_size, examples_per_batch));
             
     Lock update_lock;
 
@@ -476,12 +530,30 @@ struct Test_Examples_Job {
     {
         double local_error_rmse = 0.0;
 
-        for (unsigned x = first;  x < last;  ++x) {
-            distribution<float> output(trainer.layer->outputs());
-            trainer.layer->apply(data[x], &output[0]);
-            
-            outputs[x] = output[0];
-            local_error_rmse += pow(labels[x] - output[0], 2);
+        const Layer & layer = *trainer.layer;
+        int ni = layer.inputs(), no = layer.outputs();
+        size_t temp_space_required = layer.fprop_temporary_space_required();
+        int nb = std::min(Discriminative_Trainer::examples_per_batch,
+                          last - first);
+
+        distribution<float> inputs(nb * ni);
+        distribution<float> output(nb * no);
+        distribution<float> temp_space(nb * temp_space_required);
+
+        for (int b = first;  b < last;  b += nb) {
+            int n = std::min(nb, last - b);
+
+            for (int i = 0;  i < n;  ++i)
+                std::copy(data[b + i], data[b + i] + ni, &inputs[i * ni]);
+
+            layer.fprop_batch(n, &inputs[0], &temp_space[0],
+                              n * temp_space_required, &output[0]);
+
+            for (int i = 0;  i < n;  ++i) {
+                int x = b + i;
+                outputs[x] = output[i * no];
+                local_error_rmse += pow(labels[x] - output[i * no], 2);
+            }
         }
 
         Guard guard(update_lock);
@@ -52,6 +52,25 @@ public:
                   Parameters_Copy<double> & updates,
                   float weight = 1.0) const;
 
+    /** Train on examples[first] to examples[last - 1], forward and back
+        propagating them in batches of examples_per_batch, and add their
+        gradient to updates.  The first output of each example goes into
+        the same position of outputs.  Returns the sum of the rmse of the
+        examples.
+    */
+    double
+    train_examples(const std::vector<const float *> & data,
+                   const std::vector<Label> & labels,
+                   const std::vector<float> & weights,
+                   const Output_Encoder & encoder,
+                   const std::vector<int> & examples,
+                   int first, int last,
+                   Parameters_Copy<double> & updates,
+                   std::vector<float> & outputs) const;
+
+    /// Number of examples that are propagated together as a matrix
+    static constexpr int examples_per_batch = 64;
+
     std::pair<double, double>
     train_iter(const std::vector<distribution<float> > & data,
                const std::vector<Label> & labels,
@@ -267,6 +267,99 @@ bprop(const distribution<double> & inputs,
                          output_errors, gradient, example_weight);
 }
 
+template<typename F>
+void
+Layer::
+fprop_batch_examples(size_t n, const F * inputs,
+                     F * temp_space, size_t temp_space_size,
+                     F * outputs) const
+{
+    size_t ni = this->inputs(), no = this->outputs();
+    size_t ts = fprop_temporary_space_required();
+    if (temp_space_size != n * ts)
+        throw Exception("Layer::fprop_batch(): wrong temp space size");
+
+    for (size_t x = 0;  x < n;  ++x)
+        fprop(inputs + x * ni, temp_space + x * ts, ts, outputs + x * no);
+}
+
+void
+Layer::
+fprop_batch(size_t n, const float * inputs,
+            float * temp_space, size_t temp_space_size,
+            float * outputs) const
+{
+    fprop_batch_examples<float>(n, inputs, temp_space, temp_space_size,
+                                outputs);
+}
+
+void
+Layer::
+fprop_batch(size_t n, const double * inputs,
+            double * temp_space, size_t temp_space_size,
+            double * outputs) const
+{
+    fprop_batch_examples<double>(n, inputs, temp_space, temp_space_size,
+                                 outputs);
+}
+
+template<typename F>
+void
+Layer::
+bprop_batch_examples(size_t n,
+                     const F * inputs,
+                     const F * outputs,
+                     const F * temp_space, size_t temp_space_size,
+                     const F * output_errors,
+                     F * input_errors,
+                     Parameters & gradient,
+                     const double * example_weights) const
+{
+    size_t ni = this->inputs(), no = this->outputs();
+    size_t ts = fprop_temporary_space_required();
+    if (temp_space_size != n * ts)
+        throw Exception("Layer::bprop_batch(): wrong temp space size");
+
+    for (size_t x = 0;  x < n;  ++x) {
+        bprop(inputs + x * ni, outputs + x * no, temp_space + x * ts, ts,
+              output_errors + x * no,
+              input_errors ? input_errors + x * ni : 0,
+              gradient, example_weights[x]);
+    }
+}
+
+void
+Layer::
+bprop_batch(size_t n,
+            const float * inputs,
+            const float * outputs,
+            const float * temp_space, size_t temp_space_size,
+            const float * output_errors,
+            float * input_errors,
+            Parameters & gradient,
+            const double * example_weights) const
+{
+    bprop_batch_examples<float>(n, inputs, outputs, temp_space,
+                                temp_space_size, output_errors, input_errors,
+                                gradient, example_weights);
+}
+
+void
+Layer::
+bprop_batch(size_t n,
+            const double * inputs,
+            const double * outputs,
+            const double * temp_space, size_t temp_space_size,
+            const double * output_errors,
+            double * input_errors,
+            Parameters & gradient,
+            const double * example_weights) const
+{
+    bprop_batch_examples<double>(n, inputs, outputs, temp_space,
+                                 temp_space_size, output_errors, input_errors,
+                                 gradient, example_weights);
+}
+
 namespace {
 
 template<typename F>
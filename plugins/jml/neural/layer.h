@@ -356,6 +356,33 @@ public:
           double * temp_space,
           size_t temp_space_size) const;
 
+    /** Forward propagation of a mini-batch of n examples at once.  The
+        inputs and outputs are row major n x inputs() and n x outputs()
+        matrices, with one row per example.  The temporary space has
+        n * fprop_temporary_space_required() elements; how it is laid out
+        is up to the layer, and it must be passed unchanged to
+        bprop_batch().
+
+        The default implementation calls fprop() for each example in turn.
+        Layers that can do better (for example by doing a single matrix
+        multiply for the whole batch) should override it.
+    */
+    virtual void
+    fprop_batch(size_t n, const float * inputs,
+                float * temp_space, size_t temp_space_size,
+                float * outputs) const;
+
+    /** \copydoc fprop_batch */
+    virtual void
+    fprop_batch(size_t n, const double * inputs,
+                double * temp_space, size_t temp_space_size,
+                double * outputs) const;
+
+    template<typename F>
+    void fprop_batch_examples(size_t n, const F * inputs,
+                              F * temp_space, size_t temp_space_size,
+                              F * outputs) const;
+
     ///@}
 
 
@@ -490,6 +517,44 @@ public:
           Parameters & gradient,
           double example_weight) const;
 
+    /** Back propagation of a mini-batch of n examples at once, which were
+        forward propagated with fprop_batch().  The inputs, outputs, temp
+        space and errors are as for bprop(), but with one row per example
+        (see fprop_batch()).  Each example is weighted by the corresponding
+        entry of example_weights.  The gradient is the sum of that of each
+        of the examples.
+
+        The default implementation calls bprop() for each example in turn.
+    */
+    virtual void bprop_batch(size_t n,
+                             const float * inputs,
+                             const float * outputs,
+                             const float * temp_space, size_t temp_space_size,
+                             const float * output_errors,
+                             float * input_errors,
+                             Parameters & gradient,
+                             const double * example_weights) const;
+
+    /** \copydoc bprop_batch */
+    virtual void bprop_batch(size_t n,
+                             const double * inputs,
+                             const double * outputs,
+                             const double * temp_space, size_t temp_space_size,
+                             const double * output_errors,
+                             double * input_errors,
+                             Parameters & gradient,
+                             const double * example_weights) const;
+
+    template<typename F>
+    void bprop_batch_examples(size_t n,
+                              const F * inputs,
+                              const F * outputs,
+                              const F * temp_space, size_t temp_space_size,
+                              const F * output_errors,
+                              F * input_errors,
+                              Parameters & gradient,
+                              const double * example_weights) const;
+
     /** Second order derivatives.  Given the same information as the backprop
         function, calculate the first derivative of the error with respect
         to each parameter <b>and</b> approximate the second derivatives
@@ -204,6 +204,27 @@ struct Layer_Stack : public Layer {
           double * temp_space, size_t temp_space_size,
           double * outputs) const;
 
+    /** Forward propagate a batch through each layer in turn.  The temp
+        space is laid out by layer rather than by example: the temp space
+        of the first layer for all of the examples, then the outputs of the
+        first layer for all of the examples, and so on, so that each layer
+        sees its inputs as a single matrix.
+    */
+    template<typename F>
+    void fprop_batch(size_t n, const F * inputs,
+                     F * temp_space, size_t temp_space_size,
+                     F * outputs) const;
+
+    virtual void
+    fprop_batch(size_t n, const float * inputs,
+                float * temp_space, size_t temp_space_size,
+                float * outputs) const;
+
+    virtual void
+    fprop_batch(size_t n, const double * inputs,
+                double * temp_space, size_t temp_space_size,
+                double * outputs) const;
+
                
 
     /*************************************************************************/
@@ -237,6 +258,34 @@ struct Layer_Stack : public Layer {
                        Parameters & gradient,
                        double example_weight) const;
 
+    template<typename F>
+    void bprop_batch(size_t n,
+                     const F * inputs,
+                     const F * outputs,
+                     const F * temp_space, size_t temp_space_size,
+                     const F * output_errors,
+                     F * input_errors,
+                     Parameters & gradient,
+                     const double * example_weights) const;
+
+    virtual void bprop_batch(size_t n,
+                             const float * inputs,
+                             const float * outputs,
+                             const float * temp_space, size_t temp_space_size,
+                             const float * output_errors,
+                             float * input_errors,
+                             Parameters & gradient,
+                             const double * example_weights) const;
+
+    virtual void bprop_batch(size_t n,
+                             const double * inputs,
+                             const double * outputs,
+                             const double * temp_space, size_t temp_space_size,
+                             const double * output_errors,
+                             double * input_errors,
+                             Parameters & gradient,
+                             const double * example_weights) const;
+
     template<typename F>
     void bbprop(const F * inputs,
                 const F * outputs,
@@ -477,6 +477,147 @@ bprop(const double * inputs,
                   output_errors, input_errors, gradient, example_weight);
 }
 
+template<class LayerT>
+template<typename F>
+void
+Layer_Stack<LayerT>::
+fprop_batch(size_t n, const F * inputs,
+            F * temp_space, size_t temp_space_size,
+            F * outputs) const
+{
+    if (temp_space_size != n * fprop_temporary_space_required())
+        throw Exception("Layer_Stack::fprop_batch(): wrong temp space size");
+
+    const F * curr_inputs = inputs;
+
+    for (unsigned i = 0;  i < size();  ++i) {
+        size_t layer_temp_space_size
+            = n * layers_[i]->fprop_temporary_space_required();
+
+        F * curr_outputs
+            = (i == size() - 1
+               ? outputs
+               : temp_space + layer_temp_space_size);
+        
+        layers_[i]->fprop_batch(n, curr_inputs, temp_space,
+                                layer_temp_space_size, curr_outputs);
+
+        curr_inputs = curr_outputs;
+
+        temp_space += layer_temp_space_size;
+        if (i != size() - 1) temp_space += n * layers_[i]->outputs();
+    }
+}
+
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+fprop_batch(size_t n, const float * inputs,
+            float * temp_space, size_t temp_space_size,
+            float * outputs) const
+{
+    fprop_batch<float>(n, inputs, temp_space, temp_space_size, outputs);
+}
+
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+fprop_batch(size_t n, const double * inputs,
+            double * temp_space, size_t temp_space_size,
+            double * outputs) const
+{
+    fprop_batch<double>(n, inputs, temp_space, temp_space_size, outputs);
+}
+
+template<class LayerT>
+template<typename F>
+void
+Layer_Stack<LayerT>::
+bprop_batch(size_t n,
+            const F * inputs,
+            const F * outputs,
+            const F * temp_space, size_t temp_space_size,
+            const F * output_errors,
+            F * input_errors,
+            Parameters & gradient,
+            const double * example_weights) const
+{
+    if (temp_space_size != n * fprop_temporary_space_required())
+        throw Exception("Layer_Stack::bprop_batch(): wrong temp space size");
+
+    const F * curr_temp_space = temp_space + temp_space_size;
+    const F * curr_outputs = outputs;
+    const F * curr_output_errors = output_errors;
+
+    // The errors kept between the layers; each layer reads from one and
+    // writes to the other
+    std::vector<F> error_storage[2];
+    if (size() > 1) {
+        error_storage[0].resize(n * max_internal_width());
+        error_storage[1].resize(n * max_internal_width());
+    }
+
+    for (int i = size() - 1;  i >= 0;  --i) {
+        size_t layer_temp_space_size
+            = n * layers_[i]->fprop_temporary_space_required();
+
+        curr_temp_space -= layer_temp_space_size;
+
+        const F * curr_inputs
+            = (i == 0 ? inputs : curr_temp_space - n * layers_[i]->inputs());
+
+        F * curr_input_errors
+            = (i == 0 ? input_errors : &error_storage[i % 2][0]);
+
+        layers_[i]->bprop_batch(n, curr_inputs, curr_outputs, curr_temp_space,
+                                layer_temp_space_size, curr_output_errors,
+                                curr_input_errors,
+                                gradient.subparams(i, layers_[i]->name()),
+                                example_weights);
+
+        curr_outputs = curr_inputs;
+        curr_output_errors = curr_input_errors;
+        if (i != 0) curr_temp_space -= n * layers_[i]->inputs();
+    }
+
+    if (curr_temp_space != temp_space)
+        throw Exception("Layer_Stack::bprop_batch(): out of sync");
+}
+
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+bprop_batch(size_t n,
+            const float * inputs,
+            const float * outputs,
+            const float * temp_space, size_t temp_space_size,
+            const float * output_errors,
+            float * input_errors,
+            Parameters & gradient,
+            const double * example_weights) const
+{
+    bprop_batch<float>(n, inputs, outputs, temp_space, temp_space_size,
+                       output_errors, input_errors, gradient,
+                       example_weights);
+}
+
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+bprop_batch(size_t n,
+            const double * inputs,
+            const double * outputs,
+            const double * temp_space, size_t temp_space_size,
+            const double * output_errors,
+            double * input_errors,
+            Parameters & gradient,
+            const double * example_weights) const
+{
+    bprop_batch<double>(n, inputs, outputs, temp_space, temp_space_size,
+                        output_errors, input_errors, gradient,
+                        example_weights);
+}
+
 template<class LayerT>
 template<typename F>
 void
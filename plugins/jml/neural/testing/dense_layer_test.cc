@@ -547,3 +547,70 @@ BOOST_AUTO_TEST_CASE( test_bbprop_tanh_double_none2 )
     bbprop_test<double>(layer, context);
 }
 
+
+template<typename Float>
+void batch_test(Missing_Values missing_values, bool with_missing)
+{
+    Thread_Context context;
+    context.seed(123);
+    int ni = 20, no = 40, nx = 10;
+    Dense_Layer<Float> layer("test", ni, no, TF_TANH, missing_values, context);
+
+    boost::multi_array<Float, 2> inputs(boost::extents[nx][ni]);
+    boost::multi_array<Float, 2> errors(boost::extents[nx][no]);
+    vector<double> weights(nx);
+    for (unsigned x = 0;  x < nx;  ++x) {
+        for (unsigned i = 0;  i < ni;  ++i)
+            inputs[x][i] = context.random01() - 0.5;
+        for (unsigned o = 0;  o < no;  ++o)
+            errors[x][o] = context.random01() - 0.5;
+        weights[x] = context.random01();
+    }
+    if (with_missing)
+        inputs[3][5] = numeric_limits<Float>::quiet_NaN();
+
+    // One example at a time
+    boost::multi_array<Float, 2> outputs(boost::extents[nx][no]);
+    boost::multi_array<Float, 2> input_errors(boost::extents[nx][ni]);
+    Parameters_Copy<double> gradient(layer, 0.0);
+    for (unsigned x = 0;  x < nx;  ++x) {
+        layer.fprop(&inputs[x][0], 0, 0, &outputs[x][0]);
+        layer.bprop(&inputs[x][0], &outputs[x][0], 0, 0, &errors[x][0],
+                    &input_errors[x][0], gradient, weights[x]);
+    }
+
+    // All at once
+    boost::multi_array<Float, 2> boutputs(boost::extents[nx][no]);
+    boost::multi_array<Float, 2> binput_errors(boost::extents[nx][ni]);
+    Parameters_Copy<double> bgradient(layer, 0.0);
+    layer.fprop_batch(nx, inputs.data(), 0, 0, boutputs.data());
+    layer.bprop_batch(nx, inputs.data(), boutputs.data(), 0, 0,
+                      errors.data(), binput_errors.data(), bgradient,
+                      &weights[0]);
+
+    for (unsigned x = 0;  x < nx;  ++x) {
+        for (unsigned o = 0;  o < no;  ++o)
+            BOOST_CHECK_CLOSE(outputs[x][o], boutputs[x][o], 0.01);
+        for (unsigned i = 0;  i < ni;  ++i)
+            BOOST_CHECK_CLOSE(input_errors[x][i], binput_errors[x][i], 0.01);
+    }
+
+    for (unsigned i = 0;  i < gradient.values.size();  ++i)
+        BOOST_CHECK_CLOSE(gradient.values[i], bgradient.values[i], 0.01);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_float_zero )
+{
+    batch_test<float>(MV_ZERO, false);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_double_none )
+{
+    batch_test<double>(MV_NONE, false);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_float_dense_missing )
+{
+    // Falls back to one example at a time
+    batch_test<float>(MV_DENSE, true);
+}
@@ -210,7 +210,25 @@ ProbabilizeFunctionConfigDescription()
 }
 
 struct ProbabilizeFunction::Itl {
+    Itl(const ML::GLZ_Probabilizer & probabilizer)
+        : probabilizer(probabilizer)
+    {
+        // A single output probabilizer, which is what the training
+        // procedure produces, is precompiled into a lookup table
+        if (probabilizer.params.size() == 1
+            && probabilizer.params[0].size() == 2)
+            table.reset(new ML::Probabilizer_Table(probabilizer));
+    }
+
+    float apply(float score) const
+    {
+        if (table)
+            return table->apply(score);
+        return probabilizer.apply(ML::Label_Dist(1, score))[0];
+    }
+
     ML::GLZ_Probabilizer probabilizer;
+    std::unique_ptr<ML::Probabilizer_Table> table;
 };
 
 ProbabilizeFunction::
@@ -220,12 +238,13 @@ ProbabilizeFunction(MldbEngine * owner,
     : Function(owner, config)
 {
     functionConfig = config.params.convert<ProbabilizeFunctionConfig>();
-    itl.reset(new Itl());
     filter_istream stream(functionConfig.modelFileUrl);
     auto repr = jsonDecodeStream<ProbabilizerModel>(stream);
-    itl->probabilizer.link = repr.link;
-    itl->probabilizer.params.resize(1);
-    itl->probabilizer.params[0] = repr.params;
+    ML::GLZ_Probabilizer probabilizer;
+    probabilizer.link = repr.link;
+    probabilizer.params.resize(1);
+    probabilizer.params[0] = repr.params;
+    itl.reset(new Itl(probabilizer));
 }
 
 ProbabilizeFunction::
@@ -233,8 +252,7 @@ ProbabilizeFunction(MldbEngine * owner,
                    const ML::GLZ_Probabilizer & in)
     : Function(owner, PolyConfig())
 {
-    itl.reset(new Itl());
-    itl->probabilizer = in;
+    itl.reset(new Itl(in));
 }
 
 ProbabilizeFunction::
@@ -255,7 +273,7 @@ apply(const FunctionApplier & applier,
       const ExpressionValue & context) const
 {
     ExpressionValue score = context.getColumn(PathElement("score"));
-    float prob  = itl->probabilizer.apply(ML::Label_Dist(1, score.toDouble()))[0];
+    float prob = itl->apply(score.toDouble());
 
     StructValue result;
     result.emplace_back(PathElement("prob"),
@@ -263,6 +281,39 @@ apply(const FunctionApplier & applier,
     return result;
 }
 
+std::vector<ExpressionValue>
+ProbabilizeFunction::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    if (!itl->table)
+        return Function::applyBatch(applier, inputs);
+
+    // Evaluate all of the scores in one pass over the table
+    std::vector<ExpressionValue> scores;
+    std::vector<float> values, probs(inputs.size());
+    scores.reserve(inputs.size());
+    values.reserve(inputs.size());
+    for (auto & input: inputs) {
+        scores.emplace_back(input.getColumn(PathElement("score")));
+        values.push_back(scores.back().toDouble());
+    }
+
+    itl->table->apply(values.data(), probs.data(), values.size());
+
+    std::vector<ExpressionValue> result;
+    result.reserve(inputs.size());
+    for (size_t i = 0;  i < inputs.size();  ++i) {
+        StructValue row;
+        row.emplace_back(PathElement("prob"),
+                         ExpressionValue(probs[i],
+                                         scores[i].getEffectiveTimestamp()));
+        result.emplace_back(std::move(row));
+    }
+
+    return result;
+}
+
 FunctionInfo
 ProbabilizeFunction::
 getFunctionInfo() const
@@ -99,6 +99,10 @@ struct ProbabilizeFunction: public Function {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const;
+
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
 
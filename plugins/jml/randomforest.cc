@@ -6,3 +6,115 @@
 */
 
 #include "randomforest.h"
+#include "mldb/types/enum_description.h"
+#include <mutex>
+
+#if JML_USE_CUDA
+#include "mldb/plugins/jml/jml/stump_training_cuda.h"
+#endif
+
+
+namespace MLDB {
+
+DEFINE_ENUM_DESCRIPTION(RandomForestDevice);
+
+RandomForestDeviceDescription::
+RandomForestDeviceDescription()
+{
+    addValue("cpu", RF_DEVICE_CPU, "Train on the CPU");
+    addValue("cuda", RF_DEVICE_CUDA,
+             "Accumulate feature histograms on a CUDA GPU.  Falls back to "
+             "the CPU if there is none, or if a feature has too many "
+             "buckets to fit on the device");
+}
+
+#if JML_USE_CUDA
+
+bool randomForestCudaAvailable()
+{
+    static bool result = ML::CUDA::Test_Buckets_Binsym::deviceAvailable();
+    return result;
+}
+
+namespace {
+
+// The kernels bind global textures, so only one plan can run at once
+std::mutex cudaMutex;
+
+} // file scope
+
+void
+PartitionData::
+buildHistogramsCuda(Histograms & w) const
+{
+    typedef ML::CUDA::Test_Buckets_Binsym Tester;
+    typedef Tester::TwoBuckets TwoBuckets;
+
+    if (!randomForestCudaAvailable() || rows.empty())
+        return;
+
+    size_t n = rows.size();
+
+    // The rows are the same for every feature
+    std::vector<int32_t> labels(n);
+    std::vector<float> weights(n), exWeights(n, 1.0f);
+    for (size_t i = 0;  i < n;  ++i) {
+        labels[i] = rows[i].label;
+        weights[i] = rows[i].weight;
+    }
+
+    std::vector<uint16_t> buckets(n);
+    Tester tester;
+
+    std::unique_lock<std::mutex> guard(cudaMutex);
+
+    for (size_t f = 0;  f < features.size();  ++f) {
+        if (!features[f].active)
+            continue;
+        int numBuckets = features[f].buckets.numBuckets;
+        if (numBuckets > Tester::maxDeviceBuckets())
+            continue;
+
+        for (size_t i = 0;  i < n;  ++i)
+            buckets[i] = features[f].buckets[rows[i].exampleNum];
+
+        std::unique_ptr<TwoBuckets[]> accum(new TwoBuckets[numBuckets]);
+        TwoBuckets wLabel;
+
+        try {
+            auto plan = tester.plan(buckets.data(), nullptr, labels.data(),
+                                    nullptr, n, weights.data(),
+                                    exWeights.data(), numBuckets,
+                                    true /* on device */,
+                                    true /* compressed */);
+            auto context = tester.execute(*plan, accum.get(), wLabel);
+            tester.synchronize(*context);
+        } catch (const std::exception &) {
+            // Leave it for the CPU
+            continue;
+        }
+
+        w[f].resize(numBuckets);
+        for (int b = 0;  b < numBuckets;  ++b) {
+            w[f][b][0] = accum[b][0];
+            w[f][b][1] = accum[b][1];
+        }
+    }
+}
+
+#else // JML_USE_CUDA
+
+bool randomForestCudaAvailable()
+{
+    return false;
+}
+
+void
+PartitionData::
+buildHistogramsCuda(Histograms & w) const
+{
+}
+
+#endif // JML_USE_CUDA
+
+} // namespace MLDB
@@ -20,9 +20,24 @@
 #include "mldb/base/thread_pool.h"
 #include "mldb/engine/column_scope.h"
 #include "mldb/engine/bucket.h"
+#include "mldb/types/value_description_fwd.h"
 
 namespace MLDB {
 
+/** Device used for the heavy lifting of training random forest trees, which
+    is accumulating the histograms of the features. */
+enum RandomForestDevice {
+    RF_DEVICE_CPU,   ///< Train on the CPU
+    RF_DEVICE_CUDA   ///< Accumulate histograms on a CUDA GPU, if possible
+};
+
+DECLARE_ENUM_DESCRIPTION(RandomForestDevice);
+
+/** Can histograms be accumulated on a CUDA device?  This is false unless
+    MLDB was built with CUDA support and there is a device available.
+*/
+bool randomForestCudaAvailable();
+
 /** Holds the set of data for a partition of a decision tree. */
 struct PartitionData {
 
@@ -54,6 +69,8 @@ struct PartitionData {
         PartitionData data;
         data.features = this->features;
         data.fs = this->fs;
+        data.subtractHistograms = this->subtractHistograms;
+        data.device = this->device;
         data.reserve(numNonZero);
 
         std::vector<WritableBucketList>
@@ -180,6 +197,19 @@ struct PartitionData {
     // All features that are active
     std::vector<Feature> features;
 
+    /** If true, the histograms of the larger side of each split are
+        calculated by subtracting those of the smaller side from those of
+        the parent, rather than by scanning its rows.  Since the weights
+        are accumulated in fixed point, the result is exactly the same.
+    */
+    bool subtractHistograms = true;
+
+    /** Device on which to accumulate the histograms.  Features that can't
+        be done on a CUDA device (or all of them, if there is none) fall
+        back to the CPU; the result is the same either way.
+    */
+    RandomForestDevice device = RF_DEVICE_CPU;
+
     /** Reserve enough space for the given number of rows. */
     void reserve(size_t n)
     {
@@ -247,6 +277,60 @@ struct PartitionData {
 
     typedef WT<ML::FixedPointAccum64> W;
 
+    /** For each feature, the weight of each label for each bucket.  Empty
+        for features that are not active. */
+    typedef std::vector<std::vector<W> > Histograms;
+
+    /** Calculate the histograms of all active features by scanning the
+        rows.  This is the bulk of the work of training a tree. */
+    Histograms buildHistograms() const
+    {
+        int nf = features.size();
+        Histograms w(nf);
+
+        if (device == RF_DEVICE_CUDA)
+            buildHistogramsCuda(w);
+
+        auto doFeature = [&] (int i)
+            {
+                if (!features[i].active || !w[i].empty())
+                    return;
+
+                w[i].resize(features[i].buckets.numBuckets);
+
+                for (auto & r: rows) {
+                    int bucket = features[i].buckets[r.exampleNum];
+                    w[i][bucket][r.label] += r.weight;
+                }
+            };
+
+        parallelMap(0, nf, doFeature);
+
+        return w;
+    }
+
+    /** Calculate the histograms of the active features that can be done
+        on a CUDA device into w, leaving the others empty.  Does nothing if
+        there is no device. */
+    void buildHistogramsCuda(Histograms & w) const;
+
+    /** Subtract the histograms of a subset of our rows from ours, leaving
+        the histograms of the rest of the rows. */
+    static void subtractHistogram(Histograms & w, const Histograms & subset)
+    {
+        ExcAssertEqual(w.size(), subset.size());
+        for (size_t i = 0;  i < w.size();  ++i) {
+            if (subset[i].empty()) {
+                // No longer active in the subset, so no longer needed
+                w[i].clear();
+                continue;
+            }
+            ExcAssertEqual(w[i].size(), subset[i].size());
+            for (size_t j = 0;  j < w[i].size();  ++j)
+                w[i][j] -= subset[i][j];
+        }
+    }
+
     /** Split the partition here. */
     std::pair<PartitionData, PartitionData>
     split(int featureToSplitOn, int splitValue, const W & wLeft, const W & wRight, const W & wAll)
@@ -264,6 +348,9 @@ struct PartitionData {
         right.fs = fs;
         left.features = features;
         right.features = features;
+        left.subtractHistograms = right.subtractHistograms
+            = subtractHistograms;
+        left.device = right.device = device;
 
         bool ordinal = features[featureToSplitOn].ordinal;
 
@@ -360,6 +447,10 @@ struct PartitionData {
     /** Test all features for a split.  Returns the feature number,
         the bucket number and the goodness of the split.
 
+        The histograms of the features are taken from w if it's not empty
+        (as calculated by our parent), otherwise they are calculated from
+        the rows.  Either way, they are left in w.
+
         Outputs
         - Z score of split
         - Feature number
@@ -369,15 +460,17 @@ struct PartitionData {
         - W total (in case no split is found)
     */
     std::tuple<double, int, int, W, W, W>
-    testAll(int depth)
+    testAll(int depth, Histograms & w)
     {
         bool debug = false;
 
         int nf = features.size();
 
-        // For each feature, for each bucket, for each label
-        // weight for each bucket and last valid bucket
-        std::vector< std::vector<W> > w(nf);
+        if (w.empty())
+            w = buildHistograms();
+        ExcAssertEqual(w.size(), nf);
+
+        // For each feature, the last bucket with any weight in it
         std::vector< int > maxSplits(nf);
 
         size_t totalNumBuckets = 0;
@@ -386,9 +479,27 @@ struct PartitionData {
         for (unsigned i = 0;  i < nf;  ++i) {
             if (!features[i].active)
                 continue;
+
+            int numNonEmpty = 0;
+            int maxBucket = -1;
+            for (int j = 0;  j < w[i].size();  ++j) {
+                if (w[i][j].empty())
+                    continue;
+                ++numNonEmpty;
+                maxBucket = j;
+            }
+
+            // If all examples were in a single bucket, then the
+            // feature is no longer active.
+            if (numNonEmpty < 2) {
+                features[i].active = false;
+                w[i].clear();
+                continue;
+            }
+
+            maxSplits[i] = maxBucket;
             ++activeFeatures;
-            w[i].resize(features[i].buckets.numBuckets);
-            totalNumBuckets += features[i].buckets.numBuckets;
+            totalNumBuckets += w[i].size();
         }
 
         if (debug) {
@@ -398,49 +509,8 @@ struct PartitionData {
         }
 
         W wAll;
-
-        auto doFeature = [&] (int i)
-            {
-                int maxBucket = -1;
-
-                if (i == nf) {
-                    for (auto & r: rows) {
-                        wAll[r.label] += r.weight;
-                    }
-                    return;
-                }
-
-                if (!features[i].active)
-                    return;
-                bool twoBuckets = false;
-                int lastBucket = -1;
-
-                for (size_t j = 0;  j < rows.size();  ++j) {
-                    auto & r = rows[j];
-                    int bucket = features[i].buckets[r.exampleNum];
-
-                    twoBuckets = twoBuckets
-                        || (lastBucket != -1 && bucket != lastBucket);
-                    lastBucket = bucket;
-
-                    w[i][bucket][r.label] += r.weight;
-                    maxBucket = std::max(maxBucket, bucket);
-                }
-
-                // If all examples were in a single bucket, then the
-                // feature is no longer active.
-                if (!twoBuckets)
-                    features[i].active = false;
-
-                maxSplits[i] = maxBucket;
-            };
-
-        if (depth < 4 || true) {
-            parallelMap(0, nf + 1, doFeature);
-        }
-        else {
-            for (unsigned i = 0;  i <= nf;  ++i)
-                doFeature(i);
+        for (auto & r: rows) {
+            wAll[r.label] += r.weight;
         }
 
         // We have no impurity in our bucket.  Time to stop
@@ -597,8 +667,12 @@ struct PartitionData {
        return getLeaf(tree, wAll);
     }  
 
+    /** Train the tree below this partition.  If histograms isn't empty,
+        it holds the histograms of our rows, as calculated by our parent.
+    */
     ML::Tree::Ptr train(int depth, int maxDepth,
-                        ML::Tree & tree)
+                        ML::Tree & tree,
+                        Histograms histograms = Histograms())
     {
         if (rows.empty())
             return ML::Tree::Ptr();
@@ -616,7 +690,7 @@ struct PartitionData {
         W wAll;
         
         std::tie(bestScore, bestFeature, bestSplit, wLeft, wRight, wAll)
-            = testAll(depth);
+            = testAll(depth, histograms);
 
         if (bestFeature == -1) {
             ML::Tree::Leaf * leaf = tree.new_leaf();
@@ -633,16 +707,41 @@ struct PartitionData {
         //cerr << "left had " << splits.first.rows.size() << " rows" << endl;
         //cerr << "right had " << splits.second.rows.size() << " rows" << endl;
 
-        ML::Tree::Ptr left, right;
-        auto runLeft = [&] () { left = splits.first.train(depth + 1, maxDepth, tree); };
-        auto runRight = [&] () { right = splits.second.train(depth + 1, maxDepth, tree); };
-
         size_t leftRows = splits.first.rows.size();
         size_t rightRows = splits.second.rows.size();
 
         if (leftRows == 0 || rightRows == 0)
             throw MLDB::Exception("Invalid split in random forest");
 
+        // Only the smaller side needs to have its rows scanned; the
+        // histograms of the larger side are what's left of ours.
+        Histograms leftHistograms, rightHistograms;
+        if (subtractHistograms && depth + 1 < maxDepth) {
+            bool leftSmaller = leftRows < rightRows;
+            Histograms & smaller
+                = leftSmaller ? leftHistograms : rightHistograms;
+            Histograms & larger
+                = leftSmaller ? rightHistograms : leftHistograms;
+            smaller = (leftSmaller ? splits.first : splits.second)
+                .buildHistograms();
+            subtractHistogram(histograms, smaller);
+            larger = std::move(histograms);
+        }
+        histograms.clear();
+        histograms.shrink_to_fit();
+
+        ML::Tree::Ptr left, right;
+        auto runLeft = [&] ()
+            {
+                left = splits.first.train(depth + 1, maxDepth, tree,
+                                          std::move(leftHistograms));
+            };
+        auto runRight = [&] ()
+            {
+                right = splits.second.train(depth + 1, maxDepth, tree,
+                                            std::move(rightHistograms));
+            };
+
         ThreadPool tp;
         // Put the smallest one on the thread pool, so that we have the highest
         // probability of running both on our thread in case of lots of work.
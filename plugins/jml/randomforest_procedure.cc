@@ -72,6 +72,12 @@ RandomForestProcedureConfigDescription()
              "also be provided.");
     addField("verbosity", &RandomForestProcedureConfig::verbosity,
              "Should the procedure be verbose for debugging and tuning purposes", false);
+    addField("device", &RandomForestProcedureConfig::device,
+             "Device used to accumulate the feature histograms when training "
+             "the trees.  `cuda` uses a CUDA GPU if MLDB was built with CUDA "
+             "support and one is available, and otherwise falls back to the "
+             "CPU with a warning.  The trees are identical either way.",
+             RF_DEVICE_CPU);
     addParent<ProcedureConfig>();
 
     onPostValidate = chain(validateQuery(&RandomForestProcedureConfig::trainingData,
@@ -252,6 +258,12 @@ run(const ProcedureRunConfig & run,
     INFO_MSG(logger) << "NUM FEATURES : " << numFeatures;
 
     PartitionData allData(featureSpace);
+    if (runProcConf.device == RF_DEVICE_CUDA && !randomForestCudaAvailable()) {
+        WARNING_MSG(logger) << "no CUDA device is available; training "
+                            << "random forest on the CPU";
+        allData.device = RF_DEVICE_CPU;
+    }
+    else allData.device = runProcConf.device;
 
     allData.reserve(numRowsKept);
     size_t numRows = 0;
@@ -15,6 +15,7 @@
 #include "mldb/builtin/matrix.h"
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/plugins/jml/jml/feature_info.h"
+#include "mldb/plugins/jml/randomforest.h"
 
 
 namespace MLDB {
@@ -28,7 +29,8 @@ struct RandomForestProcedureConfig : public ProcedureConfig {
                                     featureVectorSamplingProp(0.3f),
                                     featureSamplingProp(0.3f),
                                     maxDepth(20),
-                                    verbosity(false)
+                                    verbosity(false),
+                                    device(RF_DEVICE_CPU)
     {
     }
 
@@ -57,6 +59,9 @@ struct RandomForestProcedureConfig : public ProcedureConfig {
     // Debug Verbosity
     bool verbosity;
 
+    // Device used to accumulate the feature histograms
+    RandomForestDevice device;
+
     // Function name
     Utf8String functionName;
 };
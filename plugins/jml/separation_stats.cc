@@ -10,6 +10,7 @@
 #include "mldb/arch/exception.h"
 #include "mldb/base/exc_assert.h"
 #include <boost/utility.hpp>
+#include <algorithm>
 #include "mldb/vfs/filter_streams.h"
 
 
@@ -79,6 +80,95 @@ toJson() const
 }
 
 
+/*****************************************************************************/
+/* SCORE HISTOGRAM                                                           */
+/*****************************************************************************/
+
+void
+ScoreHistogram::Bucket::
+add(const Bucket & other)
+{
+    if (empty()) {
+        key = other.key;
+        label = other.label;
+        weight = other.weight;
+    }
+
+    for (unsigned i = 0;  i < 2;  ++i) {
+        weights[i] += other.weights[i];
+        counts[i] += other.counts[i];
+    }
+}
+
+ScoreHistogram::
+ScoreHistogram(int precisionBits, size_t maxExactScores)
+    : precisionBits(precisionBits), maxExactScores(maxExactScores),
+      exact(true)
+{
+    ExcAssertGreater(precisionBits, 0);
+    ExcAssertLessEqual(precisionBits, 24);
+}
+
+float
+ScoreHistogram::
+roundScore(float score) const
+{
+    if (!std::isfinite(score) || score == 0.0f)
+        return score;
+
+    int exponent;
+    float mantissa = std::frexp(score, &exponent);
+    mantissa = std::round(std::ldexp(mantissa, precisionBits));
+    return std::ldexp(mantissa, exponent - precisionBits);
+}
+
+void
+ScoreHistogram::
+coarsen()
+{
+    std::unordered_map<float, Bucket> rounded;
+    for (auto & b: buckets)
+        rounded[roundScore(b.first)].add(b.second);
+    buckets.swap(rounded);
+    exact = false;
+}
+
+void
+ScoreHistogram::
+add(const ScoreHistogram & other)
+{
+    ExcAssertEqual(precisionBits, other.precisionBits);
+
+    if (exact && !other.exact)
+        coarsen();
+
+    for (auto & b: other.buckets)
+        buckets[exact ? b.first : roundScore(b.first)].add(b.second);
+
+    if (exact && buckets.size() > maxExactScores)
+        coarsen();
+}
+
+std::vector<std::pair<float, const ScoreHistogram::Bucket *> >
+ScoreHistogram::
+sorted() const
+{
+    std::vector<std::pair<float, const Bucket *> > result;
+    result.reserve(buckets.size());
+    for (auto & b: buckets)
+        result.emplace_back(b.first, &b.second);
+
+    std::sort(result.begin(), result.end(),
+              [] (const std::pair<float, const Bucket *> & b1,
+                  const std::pair<float, const Bucket *> & b2)
+              {
+                  return b1.first > b2.first;
+              });
+
+    return result;
+}
+
+
 /*****************************************************************************/
 /* SCORED STATS                                                              */
 /*****************************************************************************/
@@ -280,6 +370,63 @@ calculate()
     auc = totalAuc;
 }
 
+void
+ScoredStats::
+calculate(const ScoreHistogram & histogram)
+{
+    auto buckets = histogram.sorted();
+
+    BinaryStats current;
+
+    for (auto & b: buckets) {
+        for (unsigned label = 0;  label < 2;  ++label) {
+            current.counts[label][false] += b.second->weights[label];
+            current.unweighted_counts[label][false] += b.second->counts[label];
+        }
+    }
+
+    bestF = current;
+    bestMcc = current;
+    bestSpecificity = BinaryStats();
+
+    double totalAuc = 0.0;
+
+    stats.clear();
+    stats.reserve(buckets.size() + 1);
+
+    // take the all point
+    stats.push_back(BinaryStats(current, INFINITY));
+
+    for (unsigned i = 0;  i < buckets.size();  ++i) {
+        const ScoreHistogram::Bucket & bucket = *buckets[i].second;
+
+        // Everything in the bucket goes from excluded to included
+        for (unsigned label = 0;  label < 2;  ++label) {
+            current.counts[label][false] -= bucket.weights[label];
+            current.counts[label][true] += bucket.weights[label];
+            current.unweighted_counts[label][false] -= bucket.counts[label];
+            current.unweighted_counts[label][true] += bucket.counts[label];
+        }
+
+        totalAuc += current.rocAreaSince(stats.back());
+        stats.push_back(BinaryStats(current, buckets[i].first, bucket.key));
+
+        // As in calculate(), the point that includes everything can't be
+        // the best one
+        if (i == buckets.size() - 1)
+            break;
+
+        if (current.f() > bestF.f())
+            bestF = stats.back();
+        if (current.mcc() > bestMcc.mcc())
+            bestMcc = stats.back();
+        if (current.specificity() > bestSpecificity.specificity())
+            bestSpecificity = stats.back();
+    }
+
+    auc = totalAuc;
+}
+
 void
 ScoredStats::
 add(const ScoredStats & other)
@@ -13,6 +13,7 @@
 #include "mldb/utils/xdiv.h"
 #include "mldb/ext/jsoncpp/json.h"
 #include <cmath>
+#include <unordered_map>
 #include "mldb/utils/any.h"
 
 
@@ -176,6 +177,84 @@ struct BinaryStats {
 };
 
 
+/*****************************************************************************/
+/* SCORE HISTOGRAM                                                           */
+/*****************************************************************************/
+
+/** Accumulates the scores of a binary classifier in bounded memory, for
+    when there are too many scored examples to keep them all in a
+    ScoredStats.
+
+    Examples with the same score are added together into a bucket.  This
+    loses nothing, as the ROC curve only has a point per distinct score.
+    While there are at most maxExactScores distinct scores the histogram
+    is exact; past that, the scores are rounded to precisionBits
+    significant bits, which bounds the number of buckets, and the stats
+    are those of the rounded scores.
+*/
+
+struct ScoreHistogram {
+
+    ScoreHistogram(int precisionBits = 12, size_t maxExactScores = 100000);
+
+    struct Bucket {
+        double weights[2] = { 0.0, 0.0 };  ///< Weight of each label
+        double counts[2] = { 0.0, 0.0 };   ///< Number of each label
+
+        /// The first example that fell into the bucket
+        std::any key;
+        bool label = false;
+        float weight = 0.0;
+
+        bool empty() const { return counts[0] == 0 && counts[1] == 0; }
+
+        void add(const Bucket & other);
+    };
+
+    /** Update with the given values.  The score must not be NaN. */
+    void update(bool label, float score, double weight = 1.0,
+                const std::any & key = std::any())
+    {
+        Bucket & bucket = buckets[exact ? score : roundScore(score)];
+        if (bucket.empty()) {
+            bucket.key = key;
+            bucket.label = label;
+            bucket.weight = weight;
+        }
+        bucket.weights[label] += weight;
+        bucket.counts[label] += 1;
+
+        if (exact && buckets.size() > maxExactScores)
+            coarsen();
+    }
+
+    /** Add the other histogram to this one. */
+    void add(const ScoreHistogram & other);
+
+    /** Return the buckets from the highest to the lowest score. */
+    std::vector<std::pair<float, const Bucket *> > sorted() const;
+
+    /** Round the score to precisionBits significant bits. */
+    float roundScore(float score) const;
+
+    /// Are the scores of the buckets exact, or rounded?
+    bool isExact() const { return exact; }
+
+    size_t size() const { return buckets.size(); }
+
+    int precisionBits;
+    size_t maxExactScores;
+
+private:
+    /** Switch to rounded scores, merging the buckets that round to the
+        same one. */
+    void coarsen();
+
+    std::unordered_map<float, Bucket> buckets;
+    bool exact;
+};
+
+
 /*****************************************************************************/
 /* SCORED STATS                                                              */
 /*****************************************************************************/
@@ -251,6 +330,13 @@ struct ScoredStats {
     /** Calculate everything given the scored entries. */
     void calculate();
 
+    /** Calculate everything from a histogram of the scores instead of
+        from the entries, which are left untouched.  There is one element
+        of stats per bucket (after the initial one), in the order of
+        histogram.sorted().
+    */
+    void calculate(const ScoreHistogram & histogram);
+
     /** Dump a ROC curve in a JS format our visualization can use. */
     void dumpRocCurveJs(std::ostream & stream) const;
 
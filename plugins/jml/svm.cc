@@ -23,9 +23,13 @@
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/base/scope.h"
+#include "mldb/base/parallel.h"
 
 #include "mldb/ext/svm/svm.h"
 #include "mldb/utils/tmpdir.h"
+#include <random>
+#include <map>
+#include <cmath>
 
 using namespace std;
 
@@ -77,7 +81,8 @@ struct SVMParameterWrapper
         gamma = 0;    // 1/num_features
         coef0 = 0;
         nu = 0.5;
-        param.cache_size = 100;
+        cacheSize = 100;
+        fastLinear = true;
         C = 1;
         eps = 1e-3;
         p = 0.1;
@@ -95,7 +100,7 @@ struct SVMParameterWrapper
         param.gamma = gamma;    // 1/num_features
         param.coef0 = coef0;
         param.nu = nu;
-    //    param.cache_size = cache_size;
+        param.cache_size = cacheSize;
         param.C = C;
         param.eps = eps;
         param.p = p;
@@ -113,7 +118,8 @@ struct SVMParameterWrapper
     double coef0;   /* for poly/sigmoid */
 
     /* these are for training only */
-  //  double cache_size; /* in MB */
+    double cacheSize; /* in MB */
+    bool fastLinear; /* dual coordinate descent for linear classification */
     double eps; /* stopping criteria */
     double C;   /* for C_SVC, EPSILON_SVR and NU_SVR */
 //    int nr_weight;      /* for C_SVC */
@@ -154,6 +160,17 @@ SVMParameterWrapperDescription()
              "Use the shrinking heuristics", 1);
     addField("probability", &SVMParameterWrapper::probability,
              "Do probability estimated", 0);
+    addField("cacheSize", &SVMParameterWrapper::cacheSize,
+             "Size in megabytes of the cache of kernel matrix rows used "
+             "during training.  The least recently used rows are evicted "
+             "first.  A bigger cache avoids recomputing rows, which speeds "
+             "up training on large datasets", 100.0);
+    addField("fastLinear", &SVMParameterWrapper::fastLinear,
+             "For classification with the linear kernel, train with dual "
+             "coordinate descent on the weights of each pair of classes "
+             "instead of the general kernel solver.  This is much faster "
+             "when there are many examples.  Unlike the kernel solver, the "
+             "bias is regularized along with the weights", true);
 }
 
 DEFINE_STRUCTURE_DESCRIPTION(SVMConfig);
@@ -213,6 +230,226 @@ struct MLDBSVM_Problem : svm_problem
     svm_node* x_space;
 };
 
+/*****************************************************************************/
+/* LINEAR SVM                                                                */
+/*****************************************************************************/
+
+namespace {
+
+/** Train a linear SVM on two classes by dual coordinate descent (Hsieh et
+    al, 2008, as used by liblinear).  This works directly on the weight
+    vector, so each step is a sparse dot product with one example rather
+    than a row of the kernel matrix.  The examples have labels y of +1 or
+    -1, and a constant feature of 1 is added for the bias.  Returns the
+    weights, with the bias last.
+*/
+std::vector<double>
+trainLinearSvm(const svm_problem & prob,
+               const std::vector<int> & examples,
+               const std::vector<signed char> & y,
+               int numFeatures,
+               double C, double eps,
+               int maxIterations = 50000)
+{
+    size_t n = examples.size();
+    std::vector<double> w(numFeatures + 1, 0.0);
+    std::vector<double> alpha(n, 0.0);
+    std::vector<double> QD(n);
+    std::vector<int> order(n);
+
+    for (size_t i = 0;  i < n;  ++i) {
+        double total = 1.0;  // bias
+        for (const svm_node * x = prob.x[examples[i]];  x->index != -1;  ++x)
+            total += x->value * x->value;
+        QD[i] = total;
+        order[i] = i;
+    }
+
+    std::mt19937 rng(1);
+
+    // Examples whose gradient shows that they're stuck at a bound are
+    // moved past activeSize and skipped until the end (shrinking)
+    size_t activeSize = n;
+    double maxPGOld = INFINITY, minPGOld = -INFINITY;
+
+    for (int iter = 0;  iter < maxIterations;  ++iter) {
+        std::shuffle(order.begin(), order.begin() + activeSize, rng);
+
+        double maxPG = -INFINITY, minPG = INFINITY;
+
+        for (size_t s = 0;  s < activeSize;  ++s) {
+            int i = order[s];
+            const svm_node * xi = prob.x[examples[i]];
+
+            double G = w[numFeatures];
+            for (const svm_node * x = xi;  x->index != -1;  ++x)
+                G += w[x->index] * x->value;
+            G = G * y[i] - 1.0;
+
+            // Projected gradient
+            double PG = 0.0;
+            if (alpha[i] == 0.0) {
+                if (G > maxPGOld) {
+                    std::swap(order[s--], order[--activeSize]);
+                    continue;
+                }
+                PG = std::min(G, 0.0);
+            }
+            else if (alpha[i] == C) {
+                if (G < minPGOld) {
+                    std::swap(order[s--], order[--activeSize]);
+                    continue;
+                }
+                PG = std::max(G, 0.0);
+            }
+            else PG = G;
+
+            maxPG = std::max(maxPG, PG);
+            minPG = std::min(minPG, PG);
+
+            if (std::abs(PG) < 1e-12)
+                continue;
+
+            double oldAlpha = alpha[i];
+            alpha[i] = std::min(std::max(alpha[i] - G / QD[i], 0.0), C);
+            double d = (alpha[i] - oldAlpha) * y[i];
+
+            for (const svm_node * x = xi;  x->index != -1;  ++x)
+                w[x->index] += d * x->value;
+            w[numFeatures] += d;
+        }
+
+        if (maxPG - minPG <= eps) {
+            // Converged on the active examples; check again with all of
+            // them before stopping
+            if (activeSize == n)
+                break;
+            activeSize = n;
+            maxPGOld = INFINITY;
+            minPGOld = -INFINITY;
+            continue;
+        }
+
+        maxPGOld = maxPG > 0.0 ? maxPG : INFINITY;
+        minPGOld = minPG < 0.0 ? minPG : -INFINITY;
+    }
+
+    return w;
+}
+
+/** A linear one-against-one classifier in the form of a libsvm model, so
+    that it can be saved and applied like any other.  Each pair of classes
+    (i, j) has a single support vector holding its weights, which belongs
+    to class i and has a coefficient of one for that pair only.
+*/
+struct LinearSvmModel {
+    LinearSvmModel(const svm_problem & prob,
+                   const svm_parameter & param,
+                   int numFeatures)
+    {
+        // Group the examples by class, with labels in order
+        std::map<int, std::vector<int> > byLabel;
+        for (int i = 0;  i < prob.l;  ++i)
+            byLabel[(int)prob.y[i]].push_back(i);
+
+        for (auto & l: byLabel)
+            labels.push_back(l.first);
+
+        int k = labels.size();
+        if (k < 2)
+            throw AnnotatedException(400, "SVM classification requires at "
+                                     "least two different labels");
+
+        std::vector<std::pair<int, int> > pairs;
+        for (int i = 0;  i < k;  ++i)
+            for (int j = i + 1;  j < k;  ++j)
+                pairs.emplace_back(i, j);
+
+        std::vector<std::vector<double> > weights(pairs.size());
+
+        auto trainPair = [&] (size_t p)
+            {
+                const auto & pos = byLabel[labels[pairs[p].first]];
+                const auto & neg = byLabel[labels[pairs[p].second]];
+                std::vector<int> examples(pos);
+                examples.insert(examples.end(), neg.begin(), neg.end());
+                std::vector<signed char> y(pos.size(), 1);
+                y.resize(examples.size(), -1);
+                weights[p] = trainLinearSvm(prob, examples, y, numFeatures,
+                                            param.C, param.eps);
+            };
+
+        parallelMap(0, pairs.size(), trainPair);
+
+        // The pairs are in the order of libsvm's decision values, which
+        // also groups their support vectors by class
+        svs.resize(pairs.size());
+        nSV.resize(k, 0);
+        coefs.resize(k - 1, std::vector<double>(pairs.size(), 0.0));
+        for (size_t p = 0;  p < pairs.size();  ++p) {
+            for (int f = 0;  f < numFeatures;  ++f) {
+                if (weights[p][f] != 0.0)
+                    svs[p].push_back({ f, weights[p][f] });
+            }
+            svs[p].push_back({ -1, 0.0 });
+            svPtrs.push_back(svs[p].data());
+            rho.push_back(-weights[p][numFeatures]);
+            nSV[pairs[p].first] += 1;
+            coefs[pairs[p].second - 1][p] = 1.0;
+        }
+
+        for (auto & c: coefs)
+            coefPtrs.push_back(c.data());
+
+        model.param = param;
+        model.param.kernel_type = LINEAR;
+        model.nr_class = k;
+        model.l = pairs.size();
+        model.SV = svPtrs.data();
+        model.sv_coef = coefPtrs.data();
+        model.rho = rho.data();
+        model.probA = nullptr;
+        model.probB = nullptr;
+        model.sv_indices = nullptr;
+        model.label = labels.data();
+        model.nSV = nSV.data();
+        model.free_sv = 0;
+    }
+
+    svm_model model;
+
+    // Storage for the model
+    std::vector<int> labels;
+    std::vector<int> nSV;
+    std::vector<double> rho;
+    std::vector<std::vector<svm_node> > svs;
+    std::vector<svm_node *> svPtrs;
+    std::vector<std::vector<double> > coefs;
+    std::vector<double *> coefPtrs;
+};
+
+/** Compute the rows of the kernel matrix in parallel. */
+void parallelKernelRows(int begin, int end, svm_parallel_body body,
+                        void * context)
+{
+    auto onChunk = [&] (size_t first, size_t last)
+        {
+            body(context, first, last);
+        };
+
+    parallelMapChunked(begin, end, 256 /* chunk size */, onChunk);
+}
+
+struct AtInit {
+    AtInit()
+    {
+        svm_set_parallel_for_function(&parallelKernelRows);
+    }
+} atInit;
+
+} // file scope
+
+
 /*****************************************************************************/
 /* SVM PROCEDURE                                                             */
 /*****************************************************************************/
@@ -316,11 +553,23 @@ run(const ProcedureRunConfig & run,
     rows.resize(0);
     vars.resize(0);
 
-    svm_model * model = svm_train(&prob,&paramWrapper.param);
-    if(!model) {
-        throw AnnotatedException(500, "Could not train support vector machine");
+    std::unique_ptr<LinearSvmModel> linearModel;
+    svm_model * model = nullptr;
+    Scope_Exit(if (!linearModel) svm_free_and_destroy_model(&model));
+
+    if (paramWrapper.fastLinear
+        && paramWrapper.param.kernel_type == LINEAR
+        && paramWrapper.param.svm_type == C_SVC) {
+        linearModel.reset(new LinearSvmModel(prob, paramWrapper.param,
+                                             columnNames.size()));
+        model = &linearModel->model;
+    }
+    else {
+        model = svm_train(&prob,&paramWrapper.param);
+        if(!model) {
+            throw AnnotatedException(500, "Could not train support vector machine");
+        }
     }
-    Scope_Exit(svm_free_and_destroy_model(&model));
 
     auto plugin_working_dir = make_unique_directory(fs::temp_directory_path());
     auto model_tmp_name = plugin_working_dir.string() + std::string("svmmodeltemp_a.svm");
@@ -15,6 +15,7 @@
 #include "mldb/utils/testing/fixtures.h"
 #include <iostream>
 #include <stdlib.h>
+#include <random>
 
 using namespace MLDB;
 using namespace ML;
@@ -103,3 +104,94 @@ BOOST_FIXTURE_TEST_CASE( test_kmeans, kmeans_test )
     test();
 
 }
+
+namespace {
+
+/** Points around numClusters well separated centers in dim dimensions. */
+vector<distribution<float> >
+makeBlobs(int numClusters, int numPerCluster, int dim, int seed)
+{
+    mt19937 rng(seed);
+    normal_distribution<float> noise(0.0, 1.0);
+    uniform_real_distribution<float> center(-100.0, 100.0);
+
+    vector<distribution<float> > result;
+    for (int k = 0;  k < numClusters;  ++k) {
+        distribution<float> c(dim);
+        for (auto & x: c)
+            x = center(rng);
+        for (int i = 0;  i < numPerCluster;  ++i) {
+            distribution<float> point = c;
+            for (auto & x: point)
+                x += noise(rng);
+            result.push_back(point);
+        }
+    }
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_kmeans_hamerly_same_as_lloyd )
+{
+    auto data = makeBlobs(20, 200, 16, 1);
+
+    KMeans lloyd;
+    vector<int> lloydClusters;
+    lloyd.train(data, lloydClusters, 25, 100);
+
+    KMeans hamerly;
+    hamerly.algorithm = KMeans::HAMERLY;
+    vector<int> hamerlyClusters;
+    hamerly.train(data, hamerlyClusters, 25, 100);
+
+    BOOST_CHECK(lloydClusters == hamerlyClusters);
+    BOOST_REQUIRE_EQUAL(lloyd.clusters.size(), hamerly.clusters.size());
+    for (unsigned i = 0;  i < lloyd.clusters.size();  ++i) {
+        BOOST_CHECK_EQUAL(lloyd.clusters[i].nbMembers,
+                          hamerly.clusters[i].nbMembers);
+        BOOST_CHECK_SMALL(lloyd.metric->distance(lloyd.clusters[i].centroid,
+                                                 hamerly.clusters[i].centroid),
+                          1e-3);
+    }
+
+    // Hamerly needs a real metric
+    KMeans cosine(new KMeansCosineMetric());
+    cosine.algorithm = KMeans::HAMERLY;
+    vector<int> cosineClusters;
+    BOOST_CHECK_THROW(cosine.train(data, cosineClusters, 25, 100),
+                      MLDB::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_kmeans_mini_batch )
+{
+    int numClusters = 4;
+    int numPerCluster = 500;
+    auto data = makeBlobs(numClusters, numPerCluster, 8, 2);
+
+    for (auto metric: { (KMeansMetric *)new KMeansEuclideanMetric(),
+                (KMeansMetric *)new KMeansCosineMetric() }) {
+        KMeans kmeans(metric);
+        kmeans.algorithm = KMeans::MINI_BATCH;
+        kmeans.batchSize = 100;
+        vector<int> in_cluster;
+        kmeans.train(data, in_cluster, numClusters, 50);
+
+        BOOST_REQUIRE_EQUAL(in_cluster.size(), data.size());
+
+        // Well separated blobs should each end up mostly in one cluster
+        int total = 0;
+        for (int k = 0;  k < numClusters;  ++k) {
+            map<int, int> counts;
+            for (int i = 0;  i < numPerCluster;  ++i)
+                ++counts[in_cluster[k * numPerCluster + i]];
+            int most = 0;
+            for (auto & c: counts)
+                most = std::max(most, c.second);
+            total += most;
+            BOOST_CHECK_EQUAL(kmeans.assign(data[k * numPerCluster]),
+                              in_cluster[k * numPerCluster]);
+        }
+        BOOST_CHECK_GT(total, 0.9 * data.size());
+    }
+}
@@ -3,3 +3,5 @@
 $(eval $(call test,bucketing_probabilizer_test,ml,boost))
 $(eval $(call test,kmeans_test,ml test_utils,boost))
 $(eval $(call test,configuration_test,jml_utils arch,boost))
+$(eval $(call test,randomforest_benchmark,mldb_jml_plugin mldb_engine arch,boost manual))
+$(eval $(call test,score_histogram_test,ml,boost))
@@ -0,0 +1,178 @@
+/* randomforest_benchmark.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Benchmark of random forest tree training, with and without histogram
+   subtraction, and on a CUDA device if there is one.  Also checks that
+   they all give exactly the same tree.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/jml/randomforest.h"
+#include "mldb/arch/timers.h"
+#include "mldb/types/value_description.h"
+#include <random>
+#include <algorithm>
+#include <iostream>
+
+using namespace MLDB;
+using namespace std;
+
+
+namespace {
+
+/** Make a feature space of numFeatures numeric features, each with the
+    given number of buckets, with random values for numRows rows. */
+std::shared_ptr<DatasetFeatureSpace>
+makeFeatureSpace(int numFeatures, int numBuckets, size_t numRows,
+                 vector<vector<int> > & values)
+{
+    auto fs = std::make_shared<DatasetFeatureSpace>();
+
+    mt19937 rng(1);
+    uniform_int_distribution<int> bucketDist(0, numBuckets - 1);
+
+    values.resize(numFeatures);
+
+    for (int f = 0;  f < numFeatures;  ++f) {
+        ColumnPath name = PathElement("feature" + std::to_string(f));
+
+        DatasetFeatureSpace::ColumnInfo & info = fs->columnInfo[name];
+        info.columnName = name;
+        info.info = ML::Feature_Info(ML::REAL);
+        info.index = f;
+
+        vector<double> distinct;
+        for (int i = 0;  i < numBuckets;  ++i)
+            distinct.push_back(i);
+        info.bucketDescriptions.initialize(false, distinct, {});
+        info.distinctValues = info.bucketDescriptions.numBuckets();
+
+        WritableBucketList buckets(numRows, info.distinctValues);
+        values[f].resize(numRows);
+        for (size_t i = 0;  i < numRows;  ++i) {
+            values[f][i] = bucketDist(rng);
+            buckets.write(info.bucketDescriptions
+                          .getBucket(values[f][i]));
+        }
+        info.buckets = std::move(buckets);
+    }
+
+    return fs;
+}
+
+bool sameTree(const ML::Tree::Ptr & p1, const ML::Tree::Ptr & p2)
+{
+    if (!p1 || !p2)
+        return !p1 && !p2;
+    const distribution<float> & pred1 = p1.pred();
+    const distribution<float> & pred2 = p2.pred();
+    if (pred1.size() != pred2.size()
+        || !std::equal(pred1.begin(), pred1.end(), pred2.begin()))
+        return false;
+    if (!p1.node() || !p2.node())
+        return !p1.node() && !p2.node();
+    const ML::Tree::Node & n1 = *p1.node();
+    const ML::Tree::Node & n2 = *p2.node();
+    return n1.split == n2.split
+        && sameTree(n1.child_true, n2.child_true)
+        && sameTree(n1.child_false, n2.child_false)
+        && sameTree(n1.child_missing, n2.child_missing);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( benchmark_histogram_subtraction )
+{
+    int numFeatures = 50;
+    int numBuckets = 200;
+    size_t numRows = 500000;
+    int maxDepth = 12;
+
+    vector<vector<int> > values;
+    auto fs = makeFeatureSpace(numFeatures, numBuckets, numRows, values);
+
+    // The label depends on a couple of features, plus noise
+    mt19937 rng(2);
+    uniform_real_distribution<float> uniform01(0, 1);
+
+    PartitionData data(fs);
+    for (size_t i = 0;  i < numRows;  ++i) {
+        bool label = (values[0][i] > 100) != (values[1][i] < 50);
+        if (uniform01(rng) < 0.1)
+            label = !label;
+        data.addRow(label, uniform01(rng) + 0.01, i);
+    }
+
+    ML::Tree trees[2];
+    double elapsed[2];
+
+    for (bool subtract: { false, true }) {
+        PartitionData mydata(data);
+        mydata.subtractHistograms = subtract;
+
+        Timer timer;
+        ML::Tree & tree = trees[subtract];
+        tree.root = mydata.train(0 /* depth */, maxDepth, tree);
+        elapsed[subtract] = timer.elapsed_wall();
+
+        cerr << (subtract ? "with" : "without")
+             << " histogram subtraction: " << elapsed[subtract] << "s"
+             << endl;
+    }
+
+    cerr << "speedup " << elapsed[false] / elapsed[true] << endl;
+
+    BOOST_CHECK(sameTree(trees[0].root, trees[1].root));
+}
+
+BOOST_AUTO_TEST_CASE( benchmark_cuda_histograms )
+{
+    if (!randomForestCudaAvailable()) {
+        cerr << "no CUDA device available; skipping" << endl;
+        return;
+    }
+
+    int numFeatures = 50;
+    int numBuckets = 200;
+    size_t numRows = 500000;
+    int maxDepth = 12;
+
+    vector<vector<int> > values;
+    auto fs = makeFeatureSpace(numFeatures, numBuckets, numRows, values);
+
+    mt19937 rng(3);
+    uniform_real_distribution<float> uniform01(0, 1);
+
+    PartitionData data(fs);
+    for (size_t i = 0;  i < numRows;  ++i) {
+        bool label = values[2][i] + values[3][i] > numBuckets;
+        if (uniform01(rng) < 0.1)
+            label = !label;
+        data.addRow(label, uniform01(rng) + 0.01, i);
+    }
+
+    ML::Tree trees[2];
+    double elapsed[2];
+
+    for (RandomForestDevice device: { RF_DEVICE_CPU, RF_DEVICE_CUDA }) {
+        PartitionData mydata(data);
+        mydata.device = device;
+
+        Timer timer;
+        ML::Tree & tree = trees[device];
+        tree.root = mydata.train(0 /* depth */, maxDepth, tree);
+        elapsed[device] = timer.elapsed_wall();
+
+        cerr << jsonEncodeStr(device) << ": " << elapsed[device] << "s"
+             << endl;
+    }
+
+    cerr << "speedup " << elapsed[RF_DEVICE_CPU] / elapsed[RF_DEVICE_CUDA]
+         << endl;
+
+    BOOST_CHECK(sameTree(trees[RF_DEVICE_CPU].root,
+                         trees[RF_DEVICE_CUDA].root));
+}
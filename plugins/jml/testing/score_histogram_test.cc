@@ -0,0 +1,130 @@
+/* score_histogram_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test that the stats calculated from a ScoreHistogram match those of a
+   ScoredStats holding every example.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/jml/separation_stats.h"
+#include <random>
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+struct Example {
+    bool label;
+    float score;
+    float weight;
+};
+
+vector<Example> makeExamples(int n, int numDistinctScores)
+{
+    mt19937 rng(1);
+    normal_distribution<float> noise(0, 1);
+    uniform_real_distribution<float> weight(0.5, 1.5);
+
+    vector<Example> result;
+    for (int i = 0;  i < n;  ++i) {
+        bool label = i % 3 == 0;
+        float score = 1.0 / (1.0 + exp(-(noise(rng) + label)));
+        if (numDistinctScores > 0)
+            score = std::floor(score * numDistinctScores) / numDistinctScores;
+        result.push_back({ label, score, weight(rng) });
+    }
+    return result;
+}
+
+ScoredStats exactStats(const vector<Example> & examples)
+{
+    ScoredStats result;
+    for (auto & e: examples)
+        result.update(e.label, e.score, e.weight);
+    result.calculate();
+    return result;
+}
+
+// Same as a ScoredStats, but spread over several histograms like the
+// threads of the accuracy procedure
+ScoredStats histogramStats(const vector<Example> & examples,
+                           int precisionBits, size_t maxExactScores,
+                           bool & exact)
+{
+    vector<ScoreHistogram> threads(4, ScoreHistogram(precisionBits,
+                                                     maxExactScores));
+    for (unsigned i = 0;  i < examples.size();  ++i) {
+        auto & e = examples[i];
+        threads[i % threads.size()].update(e.label, e.score, e.weight);
+    }
+
+    for (unsigned i = 1;  i < threads.size();  ++i)
+        threads[0].add(threads[i]);
+
+    exact = threads[0].isExact();
+
+    ScoredStats result;
+    result.calculate(threads[0]);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_exact_histogram )
+{
+    auto examples = makeExamples(20000, 500);
+
+    ScoredStats expected = exactStats(examples);
+    bool exact;
+    ScoredStats stats = histogramStats(examples, 12, 1000, exact);
+
+    BOOST_CHECK(exact);
+    BOOST_CHECK_CLOSE(stats.auc, expected.auc, 1e-6);
+    BOOST_REQUIRE_EQUAL(stats.stats.size(), expected.stats.size());
+
+    for (unsigned i = 0;  i < stats.stats.size();  ++i) {
+        BOOST_CHECK_EQUAL(stats.stats[i].threshold,
+                          expected.stats[i].threshold);
+        BOOST_CHECK_CLOSE(stats.stats[i].truePositives(),
+                          expected.stats[i].truePositives(), 1e-6);
+        BOOST_CHECK_CLOSE(stats.stats[i].falsePositives(),
+                          expected.stats[i].falsePositives(), 1e-6);
+        BOOST_CHECK_EQUAL(stats.stats[i].includedPopulation(false),
+                          expected.stats[i].includedPopulation(false));
+    }
+
+    BOOST_CHECK_EQUAL(stats.bestF.threshold, expected.bestF.threshold);
+    BOOST_CHECK_EQUAL(stats.bestMcc.threshold, expected.bestMcc.threshold);
+}
+
+BOOST_AUTO_TEST_CASE( test_rounded_histogram )
+{
+    // Continuous scores, so every example has its own
+    auto examples = makeExamples(200000, 0);
+
+    ScoredStats expected = exactStats(examples);
+    bool exact;
+    ScoredStats stats = histogramStats(examples, 10, 10000, exact);
+
+    BOOST_CHECK(!exact);
+    BOOST_CHECK_LT(stats.stats.size(), 10000);
+    BOOST_CHECK_CLOSE(stats.auc, expected.auc, 0.01 /* percent */);
+    BOOST_CHECK_CLOSE(stats.bestF.f(), expected.bestF.f(), 0.1 /* percent */);
+}
+
+BOOST_AUTO_TEST_CASE( test_round_score )
+{
+    ScoreHistogram histogram(4);
+    BOOST_CHECK_EQUAL(histogram.roundScore(0.0), 0.0);
+    BOOST_CHECK_EQUAL(histogram.roundScore(1.0), 1.0);
+    BOOST_CHECK_EQUAL(histogram.roundScore(1.0 + 1.0 / 64), 1.0);
+    BOOST_CHECK_EQUAL(histogram.roundScore(-0.3), -0.3125);
+    BOOST_CHECK_EQUAL(histogram.roundScore(INFINITY), INFINITY);
+    BOOST_CHECK_EQUAL(histogram.roundScore(histogram.roundScore(0.77)),
+                      histogram.roundScore(0.77));
+}
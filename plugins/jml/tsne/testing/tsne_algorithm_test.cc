@@ -28,6 +28,7 @@
 #include "mldb/arch/simd_vector.h"
 #include "mldb/utils/pair_utils.h"
 #include <iomanip>
+#include <random>
 #include <set>
 
 using namespace ML;
@@ -506,6 +507,97 @@ BOOST_AUTO_TEST_CASE( test_small_approx )
     cerr << "res = " << res << endl;
 }
 #endif
+BOOST_AUTO_TEST_CASE( test_fft_repulsion )
+{
+    // Clustered points, like a t-SNE embedding
+    int nx = 2000;
+    boost::multi_array<float, 2> Y(boost::extents[nx][2]);
+    mt19937 rng(1);
+    normal_distribution<float> normal;
+    for (unsigned x = 0;  x < nx;  ++x) {
+        int cluster = x % 5;
+        Y[x][0] = normal(rng) * 2 + cluster * 6;
+        Y[x][1] = normal(rng) * 2 - cluster * 3;
+    }
+
+    double Zexact = 0.0;
+    boost::multi_array<double, 2> FrepZexact(boost::extents[nx][2]);
+    for (unsigned x = 0;  x < nx;  ++x) {
+        for (unsigned j = 0;  j < nx;  ++j) {
+            if (j == x)
+                continue;
+            double d0 = Y[j][0] - Y[x][0], d1 = Y[j][1] - Y[x][1];
+            double q = 1.0 / (1.0 + d0 * d0 + d1 * d1);
+            Zexact += q;
+            FrepZexact[x][0] += q * q * d0;
+            FrepZexact[x][1] += q * q * d1;
+        }
+    }
+
+    // More interpolation points means more accuracy
+    for (auto accuracy: { make_pair(3, 0.03), make_pair(5, 0.003) }) {
+        boost::multi_array<double, 2> FrepZ(boost::extents[nx][2]);
+        double Z = tsneRepulsionFft(Y, FrepZ, accuracy.first);
+
+        double sqrErr = 0.0, sqrTotal = 0.0;
+        for (unsigned x = 0;  x < nx;  ++x) {
+            for (unsigned i = 0;  i < 2;  ++i) {
+                sqrErr += sqr(FrepZ[x][i] - FrepZexact[x][i]);
+                sqrTotal += sqr(FrepZexact[x][i]);
+            }
+        }
+
+        cerr << accuracy.first << " points: Z " << Z << " exact " << Zexact
+             << " force error " << sqrt(sqrErr / sqrTotal) << endl;
+
+        BOOST_CHECK_CLOSE(Z, Zexact, 0.1 /* percent */);
+        BOOST_CHECK_LT(sqrt(sqrErr / sqrTotal), accuracy.second);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_small_approx_fft )
+{
+    string input_file = "mldb/tsne/testing/mnist2500_X_min.txt.gz";
+
+    filter_istream stream(input_file);
+    ParseContext context(input_file, stream);
+
+    int nd = 784;
+    int nx = 500;
+
+    boost::multi_array<float, 2> data(boost::extents[nx][nd]);
+
+    for (unsigned i = 0;  i < nx;  ++i) {
+        for (unsigned j = 0;  j < nd;  ++j) {
+            data[i][j] = context.expect_float();
+            context.expect_whitespace();
+        }
+        context.expect_eol();
+    }
+
+    TSNE_Params params;
+    params.repulsion = TSNE_REPULSION_FFT;
+
+    std::unique_ptr<VantagePointTree> vpTree;
+    std::unique_ptr<Quadtree> qtree;
+
+    boost::multi_array<float, 2> reduction
+        = tsneApproxFromCoords(data, 2, params, TSNE_Callback(),
+                               &vpTree, &qtree);
+
+    // The quadtree is still produced for re-embedding
+    BOOST_REQUIRE(vpTree);
+    BOOST_REQUIRE(qtree);
+
+    for (unsigned i = 0;  i < nx;  ++i) {
+        BOOST_CHECK(isfinite(reduction[i][0]));
+        BOOST_CHECK(isfinite(reduction[i][1]));
+    }
+
+    BOOST_CHECK_THROW(tsneApproxFromCoords(data, 3, params),
+                      std::exception);
+}
+
 #if 1
 BOOST_AUTO_TEST_CASE( test_distance_to_probability_big )
 {
@@ -0,0 +1,96 @@
+/* tsne_benchmark.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Benchmark of the wall time of t-SNE iterations with Barnes-Hut and FFT
+   interpolation repulsion, on synthetic data of 100k, 1M and 5M points.
+   The sizes can be overridden with the TSNE_BENCHMARK_SIZES environment
+   variable (comma separated).
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/jml/tsne/tsne.h"
+#include "mldb/arch/timers.h"
+#include <random>
+#include <sstream>
+#include <iostream>
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+/** Sparse neighbour probabilities for nx points in 20 clusters, with each
+    point having numNeighbours random neighbours in its own cluster. */
+std::vector<TsneSparseProbs>
+makeNeighbours(int nx, int numNeighbours)
+{
+    int numClusters = 20;
+    std::vector<TsneSparseProbs> result(nx);
+    mt19937 rng(1);
+
+    for (int x = 0;  x < nx;  ++x) {
+        int cluster = x % numClusters;
+        int clusterSize = (nx - cluster + numClusters - 1) / numClusters;
+        uniform_int_distribution<int> member(0, clusterSize - 1);
+        for (int i = 0;  i < numNeighbours;  ++i) {
+            int j;
+            do {
+                j = member(rng) * numClusters + cluster;
+            } while (j == x);
+            result[x].indexes.push_back(j);
+            result[x].probs.push_back(1.0 / ((double)numNeighbours * nx));
+        }
+    }
+
+    return result;
+}
+
+std::vector<int> benchmarkSizes()
+{
+    std::vector<int> result;
+    const char * env = getenv("TSNE_BENCHMARK_SIZES");
+    istringstream stream(env ? env : "100000,1000000,5000000");
+    string size;
+    while (getline(stream, size, ','))
+        result.push_back(stoi(size));
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( benchmark_tsne_repulsion )
+{
+    int numIterations = 20;
+
+    for (int nx: benchmarkSizes()) {
+        auto neighbours = makeNeighbours(nx, 30);
+        double elapsed[2];
+
+        for (auto repulsion: { TSNE_REPULSION_BARNES_HUT,
+                    TSNE_REPULSION_FFT }) {
+            TSNE_Params params;
+            params.max_iter = numIterations;
+            params.repulsion = repulsion;
+
+            MLDB::Timer timer;
+            boost::multi_array<float, 2> Y
+                = tsneApproxFromSparse(neighbours, 2, params);
+            elapsed[repulsion] = timer.elapsed_wall();
+
+            BOOST_CHECK_EQUAL(Y.shape()[0], nx);
+
+            cerr << nx << " points "
+                 << (repulsion == TSNE_REPULSION_FFT ? "fft" : "barnesHut")
+                 << ": " << elapsed[repulsion] / numIterations
+                 << "s per iteration" << endl;
+        }
+
+        cerr << nx << " points speedup "
+             << elapsed[TSNE_REPULSION_BARNES_HUT] / elapsed[TSNE_REPULSION_FFT]
+             << endl;
+    }
+}
@@ -34,6 +34,7 @@
 #include "mldb/utils/environment.h"
 #include "mldb/utils/quadtree.h"
 #include "mldb/utils/vantage_point_tree.h"
+#include "mldb/ext/pffft/pffft.h"
 #include <fstream>
 #include <functional>
 
@@ -1685,6 +1686,366 @@ void calcRep(const QuadtreeNode & node,
     context.calc(node, depth, inside, pointsOfInterest);
 }
 
+namespace {
+
+/** Return the indexes of the points of Y in the order of a Z-order (Morton)
+    curve over their coordinates.  Points that are close in this order are
+    close in space, so processing them in this order means that
+    consecutive points traverse mostly the same quadtree nodes, which then
+    stay in the cache.
+*/
+std::vector<int> spatialOrder(const boost::multi_array<float, 2> & Y)
+{
+    int nx = Y.shape()[0];
+    int nd = Y.shape()[1];
+    int bitsPerDim = std::min(16, 64 / std::max(nd, 1));
+
+    std::vector<float> mins(nd, INFINITY), maxs(nd, -INFINITY);
+    for (int x = 0;  x < nx;  ++x) {
+        for (int i = 0;  i < nd;  ++i) {
+            mins[i] = std::min(mins[i], Y[x][i]);
+            maxs[i] = std::max(maxs[i], Y[x][i]);
+        }
+    }
+
+    std::vector<std::pair<uint64_t, int> > codes(nx);
+
+    auto doPoint = [&] (int x)
+        {
+            uint64_t code = 0;
+            for (int i = 0;  i < nd;  ++i) {
+                double range = maxs[i] - mins[i];
+                uint64_t q = range > 0
+                    ? std::min<double>((1 << bitsPerDim) - 1,
+                                       (Y[x][i] - mins[i]) / range
+                                       * (1 << bitsPerDim))
+                    : 0;
+                for (int b = 0;  b < bitsPerDim;  ++b)
+                    code |= ((q >> b) & 1) << (b * nd + i);
+            }
+            codes[x] = { code, x };
+        };
+
+    MLDB::parallelMap(0, nx, doPoint);
+
+    std::sort(codes.begin(), codes.end());
+
+    std::vector<int> result(nx);
+    for (int x = 0;  x < nx;  ++x)
+        result[x] = codes[x].second;
+    return result;
+}
+
+/** Smallest number >= n that is a multiple of 8 with no prime factors other
+    than 2, 3 and 5.  With up to 6 interpolation points per interval, that
+    makes the padded grid size one that pffft can transform.
+*/
+int fftFriendlyIntervals(int n)
+{
+    for (n = std::max(8, (n + 7) / 8 * 8);  ;  n += 8) {
+        int m = n;
+        for (int f: { 2, 3, 5 })
+            while (m % f == 0)
+                m /= f;
+        if (m == 1)
+            return n;
+    }
+}
+
+/** In place 2 dimensional complex FFT of the m x m grid of interleaved
+    complex numbers in data, by transforming first the given number of
+    leading rows (the others must be zero) and then the given number of
+    leading columns (the others are left untransformed).  Note that pffft
+    doesn't scale the result, so backwards(forwards(x)) = m * m * x.
+*/
+void fft2d(PFFFT_Setup * setup, float * data, int m,
+           pffft_direction_t direction, int numRows, int numColumns)
+{
+    auto alloc = [&] ()
+        {
+            return std::shared_ptr<float>
+                ((float *)pffft_aligned_malloc(2 * m * sizeof(float)),
+                 [] (float * p) { pffft_aligned_free(p); });
+        };
+
+    auto doRow = [&] (int row)
+        {
+            auto work = alloc();
+            float * rowData = data + 2 * (size_t)m * row;
+            pffft_transform_ordered(setup, rowData, rowData, work.get(),
+                                    direction);
+        };
+
+    MLDB::parallelMap(0, numRows, doRow);
+
+    auto doColumn = [&] (int col)
+        {
+            auto work = alloc(), column = alloc();
+            float * c = column.get();
+            for (int row = 0;  row < m;  ++row) {
+                c[2 * row]     = data[2 * ((size_t)m * row + col)];
+                c[2 * row + 1] = data[2 * ((size_t)m * row + col) + 1];
+            }
+            pffft_transform_ordered(setup, c, c, work.get(), direction);
+            for (int row = 0;  row < m;  ++row) {
+                data[2 * ((size_t)m * row + col)]     = c[2 * row];
+                data[2 * ((size_t)m * row + col) + 1] = c[2 * row + 1];
+            }
+        };
+
+    MLDB::parallelMap(0, numColumns, doColumn);
+}
+
+} // file scope
+
+double
+tsneRepulsionFft(const boost::multi_array<float, 2> & Y,
+                 boost::multi_array<double, 2> & FrepZ,
+                 int interpolation_points,
+                 int min_intervals,
+                 double interval_width)
+{
+    static constexpr int MAX_POINTS = 6;
+
+    int nx = Y.shape()[0];
+    int p = interpolation_points;
+
+    if (Y.shape()[1] != 2)
+        throw MLDB::Exception("FFT t-SNE repulsion requires 2 dimensions");
+    if (p < 1 || p > MAX_POINTS)
+        throw MLDB::Exception("FFT t-SNE repulsion requires between 1 and %d "
+                              "interpolation points", MAX_POINTS);
+    ExcAssertEqual(FrepZ.shape()[0], nx);
+    ExcAssertEqual(FrepZ.shape()[1], 2);
+
+    if (nx == 0)
+        return 0.0;
+
+    // 1.  Lay out a square grid of intervals over the points.  Each
+    //     interval has p equispaced interpolation nodes, so that over the
+    //     whole grid there are n x n equispaced nodes.
+    float lo = INFINITY, hi = -INFINITY;
+    for (int x = 0;  x < nx;  ++x) {
+        for (int i = 0;  i < 2;  ++i) {
+            lo = std::min(lo, Y[x][i]);
+            hi = std::max(hi, Y[x][i]);
+        }
+    }
+
+    double range = std::max<double>(hi - lo, 1e-6) * (1.0 + 1e-6);
+    int numIntervals
+        = fftFriendlyIntervals(std::max<int>(min_intervals,
+                                             ceil(range / interval_width)));
+    double intervalWidth = range / numIntervals;
+    double spacing = intervalWidth / p;
+    int n = numIntervals * p;
+
+    // Padded so that the circular convolution is a linear one
+    int m = 2 * n;
+
+    // Interval and Lagrange interpolation weights for a coordinate, relative
+    // to the nodes at (k + 0.5) / p of the interval.
+    std::vector<double> denominators(p);
+    for (int k = 0;  k < p;  ++k) {
+        denominators[k] = 1.0;
+        for (int l = 0;  l < p;  ++l)
+            if (l != k)
+                denominators[k] *= double(k - l) / p;
+    }
+
+    auto getWeights = [&] (float y, double * weights) -> int
+        {
+            double pos = (y - lo) / intervalWidth;
+            int interval = std::min<int>(numIntervals - 1,
+                                         std::max(0.0, floor(pos)));
+            double t = pos - interval;
+            for (int k = 0;  k < p;  ++k) {
+                double w = 1.0;
+                for (int l = 0;  l < p;  ++l)
+                    if (l != k)
+                        w *= t - (l + 0.5) / p;
+                weights[k] = w / denominators[k];
+            }
+            return interval;
+        };
+
+    // Group the points by the interval of their first coordinate, so that
+    // each interval row can be spread onto the grid independently.  This
+    // also makes both passes over the points sweep through the grid in
+    // order, rather than jumping around.
+    std::vector<int> rowStart(numIntervals + 1);
+    std::vector<int> pointRow(nx);
+    for (int x = 0;  x < nx;  ++x) {
+        double weights[MAX_POINTS];
+        pointRow[x] = getWeights(Y[x][0], weights);
+        ++rowStart[pointRow[x] + 1];
+    }
+    for (int r = 0;  r < numIntervals;  ++r)
+        rowStart[r + 1] += rowStart[r];
+
+    std::vector<int> order(nx);
+    {
+        std::vector<int> pos(rowStart.begin(), rowStart.end() - 1);
+        for (int x = 0;  x < nx;  ++x)
+            order[pos[pointRow[x]]++] = x;
+    }
+
+    // 2.  Spread the charges 1, y0 and y1 of the points onto the nodes.
+    //     This is done in double precision, as very many points can land
+    //     on the same nodes.
+    std::vector<double> charges(3 * (size_t)n * n);
+
+    auto spreadRow = [&] (int r)
+        {
+            for (int o = rowStart[r];  o < rowStart[r + 1];  ++o) {
+                int x = order[o];
+                double w0[MAX_POINTS], w1[MAX_POINTS];
+                int i0 = getWeights(Y[x][0], w0) * p;
+                int i1 = getWeights(Y[x][1], w1) * p;
+                for (int k0 = 0;  k0 < p;  ++k0) {
+                    for (int k1 = 0;  k1 < p;  ++k1) {
+                        double w = w0[k0] * w1[k1];
+                        double * c = &charges[3 * ((size_t)n * (i0 + k0)
+                                                   + i1 + k1)];
+                        c[0] += w;
+                        c[1] += w * Y[x][0];
+                        c[2] += w * Y[x][1];
+                    }
+                }
+            }
+        };
+
+    MLDB::parallelMap(0, numIntervals, spreadRow);
+
+    // 3.  Convolve the charges with the kernels by FFT.  We need the
+    //     squared kernel 1 / (1 + d^2)^2 applied to all three charges for
+    //     the forces, and the kernel 1 / (1 + d^2) applied to the unit
+    //     charge for Z.  Both kernels are real and even, so their
+    //     transforms are real and we can transform them together as the
+    //     real and imaginary parts of one grid.  The y0 and y1 charges are
+    //     packed into one grid in the same way.
+    PFFFT_Setup * setup = pffft_new_setup(m, PFFFT_COMPLEX);
+    if (!setup)
+        throw MLDB::Exception("couldn't set up FFT of size %d", m);
+    Scope_Exit(pffft_destroy_setup(setup));
+
+    auto allocGrid = [&] ()
+        {
+            size_t size = 2 * (size_t)m * m * sizeof(float);
+            std::shared_ptr<float> result
+                ((float *)pffft_aligned_malloc(size),
+                 [] (float * p) { pffft_aligned_free(p); });
+            std::fill(result.get(), result.get() + 2 * (size_t)m * m, 0.0f);
+            return result;
+        };
+
+    auto kernelGrid = allocGrid();
+    auto unitGrid = allocGrid();
+    auto coordGrid = allocGrid();
+
+    auto initRow = [&] (int r)
+        {
+            // Node offset along each dimension for index r
+            auto offset = [&] (int i) -> double
+                {
+                    return (i < n ? i : i - m) * spacing;
+                };
+
+            float * k = kernelGrid.get() + 2 * (size_t)m * r;
+            if (r != n) {
+                for (int c = 0;  c < m;  ++c) {
+                    if (c == n)
+                        continue;
+                    double d0 = offset(r), d1 = offset(c);
+                    double q = 1.0 / (1.0 + d0 * d0 + d1 * d1);
+                    k[2 * c] = q * q;
+                    k[2 * c + 1] = q;
+                }
+            }
+
+            if (r < n) {
+                float * u = unitGrid.get() + 2 * (size_t)m * r;
+                float * y = coordGrid.get() + 2 * (size_t)m * r;
+                for (int c = 0;  c < n;  ++c) {
+                    const double * ch = &charges[3 * ((size_t)n * r + c)];
+                    u[2 * c] = ch[0];
+                    y[2 * c] = ch[1];
+                    y[2 * c + 1] = ch[2];
+                }
+            }
+        };
+
+    MLDB::parallelMap(0, m, initRow);
+
+    fft2d(setup, kernelGrid.get(), m, PFFFT_FORWARD, m, m);
+    fft2d(setup, unitGrid.get(), m, PFFFT_FORWARD, n, m);
+    fft2d(setup, coordGrid.get(), m, PFFFT_FORWARD, n, m);
+
+    // The unit charge is real, so multiplying by the packed kernels gives
+    // the squared kernel potential as the real part and the kernel
+    // potential as the imaginary part.  The coordinate charges are only
+    // multiplied by the (real) transform of the squared kernel.
+    auto multiplyRow = [&] (int r)
+        {
+            float * k = kernelGrid.get() + 2 * (size_t)m * r;
+            float * u = unitGrid.get() + 2 * (size_t)m * r;
+            float * y = coordGrid.get() + 2 * (size_t)m * r;
+            for (int c = 0;  c < m;  ++c) {
+                float kr = k[2 * c], ki = k[2 * c + 1];
+                float ur = u[2 * c], ui = u[2 * c + 1];
+                u[2 * c]     = ur * kr - ui * ki;
+                u[2 * c + 1] = ur * ki + ui * kr;
+                y[2 * c]     *= kr;
+                y[2 * c + 1] *= kr;
+            }
+        };
+
+    MLDB::parallelMap(0, m, multiplyRow);
+
+    fft2d(setup, unitGrid.get(), m, PFFFT_BACKWARD, m, n);
+    fft2d(setup, coordGrid.get(), m, PFFFT_BACKWARD, m, n);
+
+    // 4.  Interpolate the potentials back onto the points
+    double scale = 1.0 / ((double)m * m);
+    std::vector<double> exampleZ(nx);
+
+    auto interpolateRow = [&] (int r)
+        {
+            for (int o = rowStart[r];  o < rowStart[r + 1];  ++o) {
+                int x = order[o];
+                double w0[MAX_POINTS], w1[MAX_POINTS];
+                int i0 = getWeights(Y[x][0], w0) * p;
+                int i1 = getWeights(Y[x][1], w1) * p;
+                double phi[4] = { 0.0, 0.0, 0.0, 0.0 };
+                for (int k0 = 0;  k0 < p;  ++k0) {
+                    size_t offset = 2 * ((size_t)m * (i0 + k0) + i1);
+                    const float * u = unitGrid.get() + offset;
+                    const float * y = coordGrid.get() + offset;
+                    for (int k1 = 0;  k1 < p;  ++k1) {
+                        double w = w0[k0] * w1[k1];
+                        phi[0] += w * u[2 * k1];
+                        phi[1] += w * u[2 * k1 + 1];
+                        phi[2] += w * y[2 * k1];
+                        phi[3] += w * y[2 * k1 + 1];
+                    }
+                }
+
+                for (double & v: phi)
+                    v *= scale;
+
+                // The point's own contribution of 1 / (1 + 0) cancels out
+                // of the forces, but must be removed from Z.
+                FrepZ[x][0] = phi[2] - Y[x][0] * phi[0];
+                FrepZ[x][1] = phi[3] - Y[x][1] * phi[0];
+                exampleZ[x] = phi[1] - 1.0;
+            }
+        };
+
+    MLDB::parallelMap(0, numIntervals, interpolateRow);
+
+    return std::accumulate(exampleZ.begin(), exampleZ.end(), 0.0);
+}
+
 boost::multi_array<float, 2>
 tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                      int num_dims,
@@ -1698,6 +2059,11 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
     int nx = exampleNeighbours.size();
     int nd = num_dims;
 
+    bool useFft = params.repulsion == TSNE_REPULSION_FFT;
+    if (useFft && nd != 2)
+        throw MLDB::Exception("tsneApproxFromSparse(): FFT repulsion is only "
+                              "implemented for 2 dimensions");
+
     // Verify that no point is its own neighbour and that no probability is zero
     for (unsigned j = 0;  j < nx;  ++j) {
         if (exampleNeighbours[j].indexes.empty())
@@ -1835,7 +2201,20 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
             pointCoords[i] = QCoord(&Y[i][0], &Y[i][0] + nd);
         }
 
-        Quadtree & qtree = updateQtree();
+        // The repulsive forces come either from the FFT interpolation,
+        // up front for all points, or from a walk of the quadtree for
+        // each point.
+        Quadtree * qtree = nullptr;
+        double ZFft = 0.0;
+        if (useFft) {
+            ZFft = tsneRepulsionFft(Y, FrepZ,
+                                    params.fft_interpolation_points,
+                                    params.fft_min_intervals,
+                                    params.fft_interval_width);
+        }
+        else {
+            qtree = &updateQtree();
+        }
 
         // This accumulates the sum_j p[x][j] log Z*q[x][j] for each example.  From this and
         // Z, we can calculate the cost of each example.  Only relevant if calcC is true.
@@ -1861,7 +2240,8 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                 // Clear the updates
                 for (unsigned i = 0;  i < nd;  ++i) {
                     dY[x][i] = 0.0;
-                    FrepZ[x][i] = 0.0;
+                    if (!useFft)
+                        FrepZ[x][i] = 0.0;
                     FattrApprox[x][i] = 0.0;
                     FrepApprox[x][i] = 0.0;
                 }
@@ -1901,6 +2281,13 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
 
                     double factorAttr = pFactor * neighbours.probs[q] / (1.0 + D);
 
+                    // With FFT repulsion there is no quadtree walk to
+                    // calculate the cost terms, but we have Zq exactly.
+                    if (useFft && calcC) {
+                        exampleCFactorPtr[x]
+                            -= pFactor * neighbours.probs[q] * log1p(D);
+                    }
+
                     if (nd == 2) {
                         float dYj0 = y[0] - Y[j][0];
                         float dYj1 = y[1] - Y[j][1];
@@ -1915,6 +2302,9 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                     }
                 }
 
+                if (useFft)
+                    return;
+
                 // Working storage for onNode
                 distribution<double> com(nd);
 
@@ -1967,7 +2357,7 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                     for (unsigned i = 0;  i < neighbours.indexes.size();  ++i)
                         pointsOfInterest.push_back(i);
 
-                    calcRep(*qtree.root, 0, true /* inside */,
+                    calcRep(*qtree->root, 0, true /* inside */,
                             y, &FrepZ[x][0], exampleZ, nodesTouched, nd, exact,
                             onNode, pointsOfInterest, getPointCoord,
                             params.min_distance_ratio);
@@ -1985,7 +2375,7 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                     //    cerr << "x = " << x << " factor " << exampleCFactor[x] << endl;
                     ExcAssert(isfinite(exampleCFactorPtr[x]));
                 } else {
-                    calcRep(*qtree.root, 0, true /* inside */,
+                    calcRep(*qtree->root, 0, true /* inside */,
                             y, &FrepZ[x][0], exampleZ, nodesTouched, nd, exact,
                             nullptr, {}, nullptr, params.min_distance_ratio);
                 }
@@ -2003,16 +2393,22 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
 #if 1
         int totalThreads = std::max(1, std::min(16, MLDB::numCpus() / 2));
 
+        // Walk the points in spatial order, so each thread works on a
+        // compact region and its quadtree walks share cached nodes
+        std::vector<int> order;
+        if (!useFft)
+            order = spatialOrder(Y);
+
         auto doThread = [&] (int n)
             {
                 int perThread = nx / totalThreads;
                 int start = n * perThread;
                 int end = start + perThread;
-                if (n == totalThreads)
+                if (n == totalThreads - 1)
                     end = nx;
 
                 for (unsigned x = start;  x < end;  ++x)
-                    calcExample(x);
+                    calcExample(useFft ? x : order[x]);
 
                 //for (unsigned x = n;  x < nx;  x += totalThreads) {
                 //    calcExample(x);
@@ -2032,9 +2428,10 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
         // rounding errors and makes the result independent of the order
         // in which threads finish.
         std::sort(ZApproxValues.begin(), ZApproxValues.end());
-        double ZApprox = std::accumulate(ZApproxValues.begin(),
-                                         ZApproxValues.end(),
-                                         0.0);
+        double ZApprox = useFft
+            ? ZFft
+            : std::accumulate(ZApproxValues.begin(), ZApproxValues.end(),
+                              0.0);
 
         ExcAssert(isfinite(ZApprox));
         ExcAssertNotEqual(0.0, ZApprox);
@@ -117,6 +117,12 @@ distances_to_probabilities(boost::multi_array<float, 2> & D,
 boost::multi_array<float, 2>
 pca(boost::multi_array<float, 2> & coords, int num_dims = 50);
 
+/** How the repulsive forces are approximated in tsneApproxFromSparse(). */
+enum TSNE_Repulsion {
+    TSNE_REPULSION_BARNES_HUT,   ///< Barnes-Hut over a quadtree, O(n log n)
+    TSNE_REPULSION_FFT           ///< Interpolation onto a grid and FFT, O(n)
+};
+
 struct TSNE_Params {
     
     TSNE_Params()
@@ -132,7 +138,11 @@ struct TSNE_Params {
           min_gain(0.01),
           min_prob(1e-12),
           min_distance_ratio(0.6),
-          max_coord_change(0.0005)
+          max_coord_change(0.0005),
+          repulsion(TSNE_REPULSION_BARNES_HUT),
+          fft_interpolation_points(3),
+          fft_min_intervals(50),
+          fft_interval_width(1.0)
     {
     }
 
@@ -152,6 +162,11 @@ struct TSNE_Params {
 
     double min_distance_ratio;  // 0 means never approximate; 1 means approximate everything
     double max_coord_change;    // stop once no coordinate has changed its relative pos by this
+
+    TSNE_Repulsion repulsion;
+    int fft_interpolation_points;  // Interpolation points per grid interval (FFT)
+    int fft_min_intervals;         // Minimum grid intervals per dimension (FFT)
+    double fft_interval_width;     // Maximum width of a grid interval (FFT)
 };
 
 // Function that will be used as a callback to provide progress to a calling
@@ -187,6 +202,32 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & neighbours,
                      const TSNE_Callback & callback = TSNE_Callback(),
                      std::unique_ptr<Quadtree> * qtreeOut = nullptr);
 
+/** Calculate the repulsive forces of the t-SNE gradient for all the points
+    of a 2 dimensional embedding Y, using the FFT accelerated interpolation
+    of FIt-SNE:
+
+    Linderman, Rachh, Hoskins, Steinerberger and Kluger.
+    Fast interpolation-based t-SNE for improved visualization of single-cell
+    RNA-seq data.  Nature Methods 16, 243-245 (2019).
+
+    The points are spread over a grid of intervals of at most
+    interval_width (and at least min_intervals per dimension), with
+    interpolation_points Lagrange interpolation nodes per interval.  The
+    kernels are convolved with the grid by FFT and the result interpolated
+    back onto the points, which takes O(n) time rather than O(n log n) and
+    has much better memory locality than a tree traversal.
+
+    On output, FrepZ[x] = sum_j (y_j - y_x) / (1 + ||y_x - y_j||^2)^2, which
+    is Z times the repulsive force on point x, and the return value is
+    Z = sum_{x != j} 1 / (1 + ||y_x - y_j||^2).
+*/
+double
+tsneRepulsionFft(const boost::multi_array<float, 2> & Y,
+                 boost::multi_array<double, 2> & FrepZ,
+                 int interpolation_points = 3,
+                 int min_intervals = 50,
+                 double interval_width = 1.0);
+
 boost::multi_array<float, 2>
 tsneApproxFromDense(const boost::multi_array<float, 2> & probs,
                     int num_dims,
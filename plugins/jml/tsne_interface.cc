@@ -20,6 +20,7 @@
 #include "mldb/arch/simd_vector.h"
 #include "mldb/utils/vector_utils.h"
 #include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/enum_description.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/builtin/sql_config_validator.h"
 #include "mldb/utils/vantage_point_tree.h"
@@ -35,6 +36,27 @@ using namespace std;
 
 
 
+namespace ML {
+
+DEFINE_ENUM_DESCRIPTION_NAMED(TsneRepulsionDescription, TSNE_Repulsion);
+
+TsneRepulsionDescription::
+TsneRepulsionDescription()
+{
+    addValue("barnesHut", TSNE_REPULSION_BARNES_HUT,
+             "Approximate the repulsive forces with a Barnes-Hut walk of a "
+             "quadtree for each point.  Works for any number of output "
+             "dimensions.");
+    addValue("fft", TSNE_REPULSION_FFT,
+             "Approximate the repulsive forces by interpolating the points "
+             "onto a grid and convolving it by FFT (FIt-SNE).  Linear in the "
+             "number of points, and much faster than `barnesHut` for large "
+             "datasets.  Only for 2 output dimensions.");
+}
+
+} // namespace ML
+
+
 namespace MLDB {
 
 DEFINE_STRUCTURE_DESCRIPTION(TsneConfig);
@@ -93,12 +115,29 @@ TsneConfigDescription()
     addAuto("maxIterations", &TsneConfig::maxIterations,
             "Maximum number of t-SNE iterations to run (it will stop if "
             "convergance is obtained before this number of iterations). ");
+    addAuto("repulsion", &TsneConfig::repulsion,
+            "How to approximate the repulsive forces between the points on "
+            "each iteration.  The `fft` method is recommended for more "
+            "than about 100,000 points, but requires `numOutputDimensions` "
+            "to be 2.");
     addParent<ProcedureConfig>();
 
+    std::function<void (TsneConfig *, JsonParsingContext &)>
+        validateRepulsion = [] (TsneConfig * config,
+                                JsonParsingContext & context)
+        {
+            if (config->repulsion == ML::TSNE_REPULSION_FFT
+                && config->numOutputDimensions != 2)
+                throw AnnotatedException
+                    (400, "The tsne.train `fft` repulsion requires "
+                     "`numOutputDimensions` to be 2");
+        };
+
     onPostValidate = chain(validateQuery(&TsneConfig::trainingData,
                                          MustContainFrom(),
                                          NoGroupByHaving()),
-                           validateFunction<TsneConfig>());
+                           chain(validateFunction<TsneConfig>(),
+                                 validateRepulsion));
 }
 
 
@@ -248,12 +287,14 @@ run(const ProcedureRunConfig & run,
     itl->params.eta = runProcConf.learningRate;
     itl->params.min_iter = runProcConf.minIterations;
     itl->params.max_iter = runProcConf.maxIterations;
+    itl->params.repulsion = runProcConf.repulsion;
     
     DEBUG_MSG(logger) << "perplexity = " << itl->params.perplexity;
     DEBUG_MSG(logger) << "tolerance = " << itl->params.tolerance;
     DEBUG_MSG(logger) << "learningRate = " << itl->params.eta;
     DEBUG_MSG(logger) << "minIterations = " << itl->params.min_iter;
     DEBUG_MSG(logger) << "maxIterations = " << itl->params.max_iter;    
+    DEBUG_MSG(logger) << "repulsion = " << jsonEncodeStr(itl->params.repulsion);
     DEBUG_MSG(logger) << "doing t-SNE";
 
 
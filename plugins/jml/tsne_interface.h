@@ -14,6 +14,14 @@
 #include "mldb/core/value_function.h"
 #include "mldb/builtin/matrix.h"
 #include "mldb/types/value_description_fwd.h"
+#include "mldb/plugins/jml/tsne/tsne.h"
+
+
+namespace ML {
+
+DECLARE_ENUM_DESCRIPTION_NAMED(TsneRepulsionDescription, TSNE_Repulsion);
+
+} // namespace ML
 
 
 namespace MLDB {
@@ -37,6 +45,7 @@ struct TsneConfig : public ProcedureConfig {
     double learningRate = 500.0;
     int minIterations = 200;
     int maxIterations = 1000;
+    ML::TSNE_Repulsion repulsion = ML::TSNE_REPULSION_BARNES_HUT;
     
     Utf8String functionName;
 };
@@ -45,7 +45,7 @@ struct MongoRowScope : SqlRowScope {
 
 struct MongoScope : SqlExpressionMldbScope {
 
-    MongoScope(MldbEngine * engine) : SqlExpressionMldbScope(server){}
+    MongoScope(MldbEngine * engine) : SqlExpressionMldbScope(engine){}
 
     virtual ColumnGetter doGetColumn(const Utf8String & tableName,
                                      const ColumnPath & columnName) override;
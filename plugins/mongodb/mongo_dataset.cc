@@ -193,7 +193,7 @@ struct MongoDataset: Dataset {
                       ssize_t limit) const override
     {
         bool useWhere = !where.isConstantTrue();
-        MongoScope mongoScope(server);
+        MongoScope mongoScope(engine);
         const auto whereBound = where.bind(mongoScope);
 
         using mongocxx::cursor;
@@ -5,6 +5,8 @@
  * This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
  **/
 #include "bsoncxx/builder/stream/document.hpp"
+#include "bsoncxx/builder/basic/document.hpp"
+#include "bsoncxx/builder/basic/kvp.hpp"
 #include "mongocxx/client.hpp"
 #include "mongocxx/uri.hpp"
 
@@ -14,6 +16,11 @@
 #include "mldb/rest/rest_request_router.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+
+#include <atomic>
+#include <set>
 
 #include "mongo_common.h"
 
@@ -34,6 +41,7 @@ struct MongoImportConfig: ProcedureConfig {
 
     int64_t limit;
     int64_t offset;
+    int numPartitions;
     bool ignoreParsingErrors;
     SelectExpression select;
     std::shared_ptr<SqlExpression> where;
@@ -43,6 +51,7 @@ struct MongoImportConfig: ProcedureConfig {
         uriConnectionScheme(""),
         limit(-1),
         offset(0),
+        numPartitions(-1),
         ignoreParsingErrors(false),
         select(SelectExpression::STAR),
         where(SqlExpression::TRUE),
@@ -72,6 +81,11 @@ MongoImportConfigDescription()
              "Maximum number of lines to process");
     addField("offset", &MongoImportConfig::offset,
              "Skip the first n lines.", int64_t(0));
+    addField("numPartitions", &MongoImportConfig::numPartitions,
+             "Number of ranges of ObjectIDs that the collection is split into "
+             "to be read in parallel, each over its own connection.  The "
+             "default of -1 uses one per CPU.  The collection is read with "
+             "a single cursor when limit or offset is set.", -1);
     addField("ignoreParsingErrors", &MongoImportConfig::ignoreParsingErrors,
              "If true, any record causing an error will be skipped. Any "
              "record with BSON regex or BSON internal data type will cause an "
@@ -100,7 +114,7 @@ struct MongoImportProcedure: public Procedure {
     MongoImportProcedure(MldbEngine * engine,
                          PolyConfig config_,
                          std::function<bool (Json::Value)> onProgress)
-        : Procedure(server)
+        : Procedure(engine)
     {
         config = config_.params.convert<MongoImportConfig>();
     }
@@ -116,6 +130,8 @@ struct MongoImportProcedure: public Procedure {
     RunOutput run(const ProcedureRunConfig & run,
                   const std::function<bool (const Json::Value &)> & onProgress) const override
     {
+        using bsoncxx::builder::basic::kvp;
+
         const auto runConfig = applyRunConfOverProcConf(config, run);
 
         mongocxx::uri mongoUri(runConfig.uriConnectionScheme);
@@ -126,11 +142,10 @@ struct MongoImportProcedure: public Procedure {
             << "Db name:    " << mongoUri.database() << "\n"
             << "Collection: " << runConfig.collection;
 
-        auto output = createDataset(server, runConfig.outputDataset,
+        auto output = createDataset(engine, runConfig.outputDataset,
                                     nullptr, true /*overwrite*/);
 
-        MongoScope mongoScope(server);
-        ExpressionValue storage;
+        MongoScope mongoScope(engine);
         const auto whereBound  = runConfig.where->bind(mongoScope);
         const auto selectBound = runConfig.select.bind(mongoScope);
         const auto namedBound  = runConfig.named->bind(mongoScope);
@@ -141,8 +156,36 @@ struct MongoImportProcedure: public Procedure {
         // using incorrect default value to ease check
         bool useNamed = config.named != SqlExpression::TRUE;
 
-        auto processor = [&](Dataset & output,
-                             const bsoncxx::document::view & doc)
+        mongocxx::options::find findOptions;
+        findOptions.batch_size(1000);
+
+        // When the select doesn't need the whole document, only the top
+        // level fields that are used are fetched from the server
+        if (useSelect) {
+            UnboundEntities unbound = runConfig.select.getUnbound();
+            unbound.merge(runConfig.where->getUnbound());
+            unbound.merge(runConfig.named->getUnbound());
+
+            if (unbound.wildcards.empty() && unbound.tables.empty()
+                && !unbound.hasRowFunctions()) {
+                bsoncxx::builder::basic::document projection;
+                projection.append(kvp("_id", 1));
+                std::set<std::string> fields;
+                for (auto & v: unbound.vars) {
+                    if (v.first.empty())
+                        continue;
+                    std::string field = v.first.front().toUtf8String().rawString();
+                    if (field != "_id" && fields.insert(field).second)
+                        projection.append(kvp(field, 1));
+                }
+                DEBUG_MSG(logger) << "Fetching only " << fields.size()
+                                  << " fields";
+                findOptions.projection(projection.extract());
+            }
+        }
+
+        auto processor = [&](const bsoncxx::document::view & doc,
+                             std::vector<std::pair<RowPath, ExpressionValue> > & rows)
         {
             if (doc["_id"].type() != bsoncxx::type::k_oid) {
                 throw AnnotatedException(
@@ -157,6 +200,7 @@ struct MongoImportProcedure: public Procedure {
             ExpressionValue expr(extract(ts, doc));
 
             if (useWhere || useSelect || useNamed) {
+                ExpressionValue storage;
                 MongoRowScope row(expr, oid.value.to_string());
                 if (useWhere && !whereBound(row, storage, GET_ALL).isTrue()) {
                     return;
@@ -172,15 +216,86 @@ struct MongoImportProcedure: public Procedure {
                 }
             }
 
-            output.recordRowExpr(rowName, expr);
+            rows.emplace_back(std::move(rowName), std::move(expr));
+        };
+
+        std::atomic<int> errors(0);
+        std::atomic<size_t> rowsInserted(0);
+
+        auto processDoc = [&] (const bsoncxx::document::view & doc,
+                               std::vector<std::pair<RowPath, ExpressionValue> > & rows)
+        {
+            if (++rowsInserted % 1000 == 0) {
+                DEBUG_MSG(logger) << "Processing " << rowsInserted
+                                  << "th document";
+            }
+            if (!runConfig.ignoreParsingErrors) {
+                processor(doc, rows);
+                return;
+            }
+            try {
+                processor(doc, rows);
+            }
+            catch (const MLDB::Exception & exc) {
+                int n = ++errors;
+                if (n <= 100) {
+                    logger->error() << exc.what();
+                }
+                if (n == 100) {
+                    logger->error() <<
+                        "100 errors logged, not logging them anymore.";
+                }
+            }
+        };
+
+        auto recorder = output->getChunkRecorder();
+        std::atomic<size_t> chunkNumber(0);
+
+        // Rows are converted and recorded in batches, and each chunk of
+        // the output holds rowsPerChunk rows
+        static constexpr size_t rowsPerBatch = 1000;
+        static constexpr size_t rowsPerChunk = 65536;
+
+        struct ChunkWriter {
+            std::unique_ptr<Recorder> chunk;
+            size_t rowsInChunk = 0;
+            std::vector<std::pair<RowPath, ExpressionValue> > rows;
+        };
+
+        auto flush = [&] (ChunkWriter & writer)
+        {
+            if (writer.rows.empty())
+                return;
+            if (!writer.chunk) {
+                writer.chunk = recorder.newChunk(chunkNumber.fetch_add(1));
+                writer.rowsInChunk = 0;
+            }
+            writer.rowsInChunk += writer.rows.size();
+            writer.chunk->recordRowsExprDestructive(std::move(writer.rows));
+            writer.rows.clear();
+            if (writer.rowsInChunk >= rowsPerChunk) {
+                writer.chunk->finishedChunk();
+                writer.chunk.reset();
+            }
         };
 
-        auto offset = runConfig.offset;
-        auto limit = runConfig.limit;
-        int errors = 0;
-        size_t rowsInserted = 0;
+        auto finish = [&] (ChunkWriter & writer)
         {
-            auto cursor = db[runConfig.collection].find({});
+            flush(writer);
+            if (writer.chunk)
+                writer.chunk->finishedChunk();
+        };
+
+        std::vector<bsoncxx::document::value> partitions;
+        if (runConfig.offset == 0 && runConfig.limit == -1)
+            partitions = getPartitions(db[runConfig.collection],
+                                       runConfig.numPartitions);
+
+        if (partitions.empty()) {
+            auto offset = runConfig.offset;
+            auto limit = runConfig.limit;
+            ChunkWriter writer;
+            auto cursor = db[runConfig.collection].find({}, findOptions);
             for (auto&& doc : cursor) {
                 if (offset > 0) {
                     --offset;
@@ -192,37 +307,104 @@ struct MongoImportProcedure: public Procedure {
                 else if (limit > 0) {
                     --limit;
                 }
-                if (++rowsInserted % 1000 == 0) {
-                    DEBUG_MSG(logger) << "Processing " << rowsInserted
-                                      << "th document";
-                }
-                if (runConfig.ignoreParsingErrors) {
-                    try {
-                        processor(*output.get(), doc);
-                    }
-                    catch (const MLDB::Exception & exc) {
-                        ++ errors;
-                        if (errors <= 100) {
-                            logger->error() << exc.what();
-                        }
-                        if (errors == 100) {
-                            logger->error() <<
-                                "100 errors logged, not logging them anymore.";
-                        }
-                    }
-                }
-                else {
-                    processor(*output.get(), doc);
-                }
+                processDoc(doc, writer.rows);
+                if (writer.rows.size() >= rowsPerBatch)
+                    flush(writer);
             }
-            DEBUG_MSG(logger) << "Fetched " << rowsInserted << " documents";
+            finish(writer);
+        }
+        else {
+            DEBUG_MSG(logger) << "Reading " << partitions.size()
+                              << " ObjectID ranges in parallel";
+
+            // The client isn't thread safe, so each partition has its own
+            auto readPartition = [&] (size_t p)
+            {
+                mongocxx::client conn(mongoUri);
+                auto db = conn[mongoUri.database()];
+                ChunkWriter writer;
+                auto cursor = db[runConfig.collection]
+                    .find(partitions[p].view(), findOptions);
+                for (auto&& doc : cursor) {
+                    processDoc(doc, writer.rows);
+                    if (writer.rows.size() >= rowsPerBatch)
+                        flush(writer);
+                }
+                finish(writer);
+            };
+
+            parallelMap(0, partitions.size(), readPartition);
         }
-        output->commit();
+
+        DEBUG_MSG(logger) << "Fetched " << rowsInserted << " documents";
+
+        recorder.commit();
         Json::Value res = jsonEncode(output->getStatus());
-        res["numParsingErrors"] = errors;
-        res["numInsertedRows"] = rowsInserted;
+        res["numParsingErrors"] = errors.load();
+        res["numInsertedRows"] = rowsInserted.load();
         return RunOutput(res);
     }
+
+    /** Return a filter for each of the ranges of ObjectIDs that the
+        collection is split into.  ObjectIDs start with their creation
+        time in seconds, so the ranges split the time between the first
+        and last ObjectIDs into equal parts.  If the collection's ids
+        aren't ObjectIDs, or it can't be split, an empty list is returned.
+    */
+    std::vector<bsoncxx::document::value>
+    getPartitions(mongocxx::collection collection, int numPartitions) const
+    {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+
+        auto getTime = [&] (int order) -> int64_t
+            {
+                mongocxx::options::find opts;
+                opts.sort(make_document(kvp("_id", order)));
+                opts.projection(make_document(kvp("_id", 1)));
+                opts.limit(2); // Limit 1 yields error unset document::element
+                for (auto&& doc: collection.find({}, opts)) {
+                    if (doc["_id"].type() != bsoncxx::type::k_oid)
+                        return -1;
+                    return doc["_id"].get_oid().value.get_time_t();
+                }
+                return -1;
+            };
+
+        int64_t first = getTime(1);
+        int64_t last = getTime(-1);
+        if (first == -1 || last == -1)
+            return {};
+
+        int64_t n = numPartitions > 0 ? numPartitions : numCpus();
+        n = std::min(n, last - first + 1);
+        if (n <= 1)
+            return {};
+
+        // ObjectID with the given time and all other bytes zero, which
+        // sorts before all ObjectIDs created at that time
+        auto oidForTime = [] (int64_t time)
+            {
+                char bytes[12] = { 0 };
+                bytes[0] = (time >> 24) & 0xff;
+                bytes[1] = (time >> 16) & 0xff;
+                bytes[2] = (time >> 8) & 0xff;
+                bytes[3] = time & 0xff;
+                return bsoncxx::types::b_oid{bsoncxx::oid(bytes, sizeof(bytes))};
+            };
+
+        std::vector<bsoncxx::document::value> result;
+        for (int64_t p = 0;  p < n;  ++p) {
+            bsoncxx::builder::basic::document range;
+            if (p > 0)
+                range.append(kvp("$gte", oidForTime(first + (last - first + 1) * p / n)));
+            if (p < n - 1)
+                range.append(kvp("$lt", oidForTime(first + (last - first + 1) * (p + 1) / n)));
+            result.emplace_back(make_document(
+                kvp("_id", bsoncxx::types::b_document{range.view()})));
+        }
+        return result;
+    }
 };
 
 static RegisterProcedureType<MongoImportProcedure, MongoImportConfig>
@@ -7,6 +7,7 @@
 #include "bsoncxx/builder/stream/document.hpp"
 #include "bsoncxx/builder/stream/array.hpp"
 #include "mongocxx/client.hpp"
+#include "mongocxx/pool.hpp"
 
 #include "mldb/core/function.h"
 #include "mldb/core/dataset.h"
@@ -54,8 +55,10 @@ typedef tuple<ColumnPath, CellValue, Date> Cell;
 
 struct MongoRecord: Dataset {
 
-    mongocxx::client conn;
-    mongocxx::database db;
+    /// Clients can't be shared between threads, so each write takes one
+    /// from the pool
+    std::unique_ptr<mongocxx::pool> pool;
+    string database;
     string collection;
 
     MongoRecord(MldbEngine * owner,
@@ -65,8 +68,8 @@ struct MongoRecord: Dataset {
     {
         auto dsConfig = config.params.convert<MongoRecordConfig>();
         mongocxx::uri mongoUri(dsConfig.uriConnectionScheme);
-        conn = mongocxx::client(mongoUri);
-        db = conn[mongoUri.database()];
+        pool.reset(new mongocxx::pool(mongoUri));
+        database = mongoUri.database();
         collection = dsConfig.collection;
     }
     
@@ -75,8 +78,8 @@ struct MongoRecord: Dataset {
         return std::string("ok");
     }
 
-    void recordRowItl(const Path & rowName,
-                      const std::vector<Cell> & row) override
+    bsoncxx::document::value makeDocument(const Path & rowName,
+                                          const std::vector<Cell> & row) const
     {
         using bsoncxx::builder::stream::document;
 
@@ -131,15 +134,104 @@ struct MongoRecord: Dataset {
                     << jsonEncodeUtf8(cellValue).rawString();
             }
         }
-        db[collection].insert_one(topDoc.extract());
+        return topDoc.extract();
+    }
+
+    /// Write the documents with a single bulk insert
+    void insertDocuments(const std::vector<bsoncxx::document::value> & docs)
+    {
+        if (docs.empty())
+            return;
+        auto client = pool->acquire();
+        (*client)[database][collection].insert_many(docs);
+    }
+
+    void recordRowItl(const Path & rowName,
+                      const std::vector<Cell> & row) override
+    {
+        std::vector<bsoncxx::document::value> docs;
+        docs.emplace_back(makeDocument(rowName, row));
+        insertDocuments(docs);
     }
 
     void recordRows(
         const std::vector<std::pair<Path, std::vector<Cell>>> & rows) override
     {
+        std::vector<bsoncxx::document::value> docs;
+        docs.reserve(rows.size());
         for (const auto & row: rows) {
-            recordRowItl(row.first, row.second);
+            docs.emplace_back(makeDocument(row.first, row.second));
+        }
+        insertDocuments(docs);
+    }
+
+    /** Recorder for one chunk, that converts rows to documents as they
+        arrive and inserts them in bulk.
+    */
+    struct ChunkRecorder: public Recorder {
+        ChunkRecorder(MongoRecord * dataset)
+            : Recorder(dataset->engine), dataset(dataset)
+        {
+        }
+
+        /// Documents accumulated before they are inserted
+        static constexpr size_t docsPerBatch = 1000;
+
+        MongoRecord * dataset;
+        std::vector<bsoncxx::document::value> docs;
+
+        void recordRowExpr(const RowPath & rowName,
+                           const ExpressionValue & expr) override
+        {
+            RowValue row;
+            expr.appendToRow(ColumnPath(), row);
+            recordRow(rowName, row);
+        }
+
+        void recordRow(const RowPath & rowName,
+                       const std::vector<Cell> & vals) override
+        {
+            docs.emplace_back(dataset->makeDocument(rowName, vals));
+            if (docs.size() >= docsPerBatch)
+                flush();
+        }
+
+        void recordRows(
+            const std::vector<std::pair<Path, std::vector<Cell>>> & rows) override
+        {
+            for (auto & r: rows)
+                recordRow(r.first, r.second);
+        }
+
+        void recordRowsExpr(
+            const std::vector<std::pair<RowPath, ExpressionValue > > & rows) override
+        {
+            for (auto & r: rows)
+                recordRowExpr(r.first, r.second);
+        }
+
+        void finishedChunk() override
+        {
+            flush();
+        }
+
+        void flush()
+        {
+            dataset->insertDocuments(docs);
+            docs.clear();
         }
+    };
+
+    MultiChunkRecorder getChunkRecorder() override
+    {
+        MultiChunkRecorder result;
+        result.newChunk = [=] (size_t)
+            {
+                return std::unique_ptr<Recorder>(new ChunkRecorder(this));
+            };
+
+        result.commit = [=] () { this->commit(); };
+        return result;
     }
 
     std::shared_ptr<MatrixView> getMatrixView() const override
@@ -192,6 +192,56 @@ class MongodbPluginTest(MldbUnitTest):  # noqa
         for r in res[1:]:
             self.assertEqual(r[0], r[1])
 
+    @unittest.skipIf(not got_mongod, "mongod not available")
+    def test_import_select_in_parallel(self):
+        """
+        Only the fields used by select are fetched, and the collection is
+        read as several ranges of ObjectIDs.
+        """
+        mldb.post('/v1/procedures', {
+            'type' : 'mongodb.import',
+            'params' : {
+                'uriConnectionScheme' : self.connection_scheme,
+                'collection' : self.collection_name,
+                'outputDataset' : {
+                    'id' : 'imported_select',
+                    'type' : 'tabular'
+                },
+                'select' : 'type, obj.d AS d',
+                'where' : 'type IS NOT NULL',
+                'numPartitions' : 3
+            }
+        })
+        res = mldb.query(
+            "SELECT type, d FROM imported_select ORDER BY rowName()")
+        self.assertEqual([r[1:] for r in res[1:]],
+                         [['simple', None],
+                          ['nested_obj', 'e'],
+                          ['nested_arr', None]])
+
+    @unittest.skipIf(not got_mongod, "mongod not available")
+    def test_record_bulk(self):
+        """
+        Rows recorded by a transform are inserted in bulk.
+        """
+        mldb.post('/v1/procedures', {
+            'type' : 'transform',
+            'params' : {
+                'inputData' : 'SELECT 1 AS x, 2 AS y',
+                'outputDataset' : {
+                    'id' : 'ds_record_bulk',
+                    'type' : 'mongodb.record',
+                    'params' : {
+                        'uriConnectionScheme' : self.connection_scheme,
+                        'collection' : 'record_bulk'
+                    }
+                }
+            }
+        })
+        rows = list(self.pymongo_db.record_bulk.find())
+        self.assertEqual(len(rows), 1)
+        self.assertEqual(rows[0]['y'], 2)
+
     def test_invalid_connection_scheme(self):
         msg = 'the minimal uriConnectionScheme format is'
         with self.assertRaisesRegex(ResponseException, msg):
@@ -17,7 +17,10 @@
 #include "mldb/types/any_impl.h"
 #include "mldb/types/annotated_exception.h"
 #include "mldb/ext/tinyxml2/tinyxml2.h"
+#include "xml_pull_parser.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/parallel.h"
+#include <atomic>
 
 
 using namespace std;
@@ -58,69 +61,75 @@ XlsxImporterConfigDescription()
              "Configuration for output dataset");
 }
 
+/** Table of the strings that cells refer to by index.  It can have millions
+    of entries, so it's read as a stream and frozen into a single character
+    buffer with an offset per string, rather than held as a string object
+    each.
+*/
 struct SharedStrings {
 
     void load(std::streambuf * buf, shared_ptr<spdlog::logger> logger)
     {
-        std::ostringstream allText;
-        allText << buf;
-
-        unique_ptr<tinyxml2::XMLDocument> xml(new tinyxml2::XMLDocument());
-        xml->Parse(allText.str().c_str());
-
-        TRACE_MSG(logger) << "loaded document:\n" << printDoc(*xml);
-
-        using namespace tinyxml2;
-
-        XMLHandle handle(*xml);
-
-        XMLElement * sst = handle.FirstChildElement("sst").ToElement();
+        XmlPullParser parser(buf);
+
+        bool foundSst = false;
+        int64_t numStrings = -1;
+
+        for (auto event = parser.next();  event != XmlPullParser::END_DOCUMENT;
+             event = parser.next()) {
+            if (event != XmlPullParser::START_ELEMENT)
+                continue;
+            const std::string & name = parser.name();
+
+            if (name == "sst") {
+                foundSst = true;
+                if (auto count = parser.attr("uniqueCount")) {
+                    numStrings = std::stoll(*count);
+                    DEBUG_MSG(logger) << "got " << numStrings
+                                      << " unique strings";
+                    offsets.reserve(numStrings + 1);
+                }
+            }
+            else if (name == "si") {
+                readStringItem(parser, chars);
+                offsets.push_back(chars.size());
+            }
+        }
 
-        if (!sst)
+        if (!foundSst)
             throw AnnotatedException(400, "xlsx file SharedStrings have no sst element");
 
+        DEBUG_MSG(logger) << "read " << size() << " unique strings";
 
-        unsigned numStrings;
-        int res = sst->QueryUnsignedAttribute("uniqueCount", &numStrings);
-        if (res != XML_NO_ERROR)
-            throw AnnotatedException(400, "xlsx file SharedStrings have no uniqueCount");
-
-        DEBUG_MSG(logger) << "got " << numStrings << " unique strings";
-
-        strings.reserve(numStrings);
-
-
-
-        for (XMLNode * node = sst->FirstChildElement();  node;
-             node = node->NextSibling()) {
-            XMLHandle handle(*node);
-
-            XMLElement * text = handle.FirstChildElement("t").ToElement();
-
-            if (!text)
-                throw AnnotatedException(400, "xlsx file SharedStrings <si> element has no child <t> element");
-
-            const char * t = text->GetText();
-
-            Utf8String textStr(t ? t : "");
-
-            DEBUG_MSG(logger) << "got string " << textStr;
-
-            strings.emplace_back(std::move(textStr));
-        }
-
-        DEBUG_MSG(logger) << "read " << strings.size() << " unique strings";
-
-        if (numStrings != strings.size()) {
+        if (numStrings != -1 && numStrings != size()) {
             throw AnnotatedException(400, "xlsx file SharedStrings file consistency error: number of strings read doesn't match definition",
                                       "numDefined", numStrings,
-                                      "numRead", strings.size());
+                                      "numRead", size());
 
         }
 
+        chars.shrink_to_fit();
+        offsets.shrink_to_fit();
     }
 
-    std::vector<Utf8String> strings;
+    int64_t size() const
+    {
+        return offsets.size() - 1;
+    }
+
+    CellValue get(int64_t index) const
+    {
+        if (index < 0 || index >= size())
+            throw AnnotatedException(400, "xlsx cell refers to a shared string that doesn't exist",
+                                     "index", index,
+                                     "numStrings", size());
+        return CellValue(Utf8String(chars.data() + offsets[index],
+                                    offsets[index + 1] - offsets[index]));
+    }
+
+private:
+    std::string chars;                     ///< All strings, end to end
+    std::vector<uint64_t> offsets = { 0 }; ///< Start of each string, then end
 };
 
 const map<string, CellValue::CellType> FORMATS = {
@@ -484,187 +493,248 @@ struct Workbook {
     }
 };
 
-struct Sheet {
-
-    Sheet(std::streambuf * buf,
-          const Workbook & workbook,
-          const SharedStrings & strings,
-          const Styles & styles,
-          shared_ptr<spdlog::logger> logger)
-    {
-        std::ostringstream allText;
-        allText << buf;
-
-        unique_ptr<tinyxml2::XMLDocument> xml(new tinyxml2::XMLDocument());
-        xml->Parse(allText.str().c_str());
-
-        TRACE_MSG(logger) << "workbook sheet contents" << printDoc(*xml);
-
-        using namespace tinyxml2;
-
-        XMLHandle handle(*xml);
-
-        XMLElement * data
-            = handle.FirstChildElement("worksheet")
-            .FirstChildElement("sheetData")
-            .ToElement();
-
-        if (!data)
-            throw AnnotatedException(400, "xlsx worksheet has no sheetData element");
-
-        for (XMLNode * node = data->FirstChildElement("row");  node;
-             node = node->NextSibling()) {
-            XMLElement * element = node->ToElement();
-            if (!element)
-                throw AnnotatedException(400, "xlsx worksheet Relationship entry is not an element");
-
-            auto readAttr = [&] (const std::string & attr) -> Utf8String
-                {
-                    const char * foundAttr
-                        = element->Attribute(attr.c_str());
-                    if (!foundAttr)
-                        return Utf8String();
-                    return Utf8String(foundAttr);
-                };
-
-            // What is the row index?
-            int64_t rowIndex = CellValue::parse(readAttr("r")).toInt();
-
-            Row row;
-            row.index = rowIndex;
-
-            int64_t colIndex = 0;
+/** Reads the rows of a worksheet as it streams out of the archive, so that
+    a sheet never needs to be held in memory in full.
+*/
+struct SheetReader {
 
-            for (XMLNode * colNode = element->FirstChildElement("c");  colNode;
-                 colNode = colNode->NextSibling()) {
+    struct Row {
+        int64_t index;   ///< Row index, 1-based
+        std::vector<std::tuple<int64_t, CellValue> > columns;
+    };
 
-                XMLElement * colElement = colNode->ToElement();
+    SheetReader(const Workbook & workbook,
+                const SharedStrings & strings,
+                const Styles & styles,
+                shared_ptr<spdlog::logger> logger)
+        : workbook(workbook), strings(strings), styles(styles), logger(logger)
+    {
+    }
 
-                if (!colElement)
-                    throw AnnotatedException(400, "xlsx sheet column is not an element");
+    const Workbook & workbook;
+    const SharedStrings & strings;
+    const Styles & styles;
+    shared_ptr<spdlog::logger> logger;
 
-                auto readAttr = [&] (const std::string & attr) -> Utf8String
-                    {
-                        const char * foundAttr
-                            = colElement->Attribute(attr.c_str());
-                        if (!foundAttr)
-                            return Utf8String();
-                        return Utf8String(foundAttr);
-                    };
+    /** Return the index of the last row of the sheet, or -1 if it has no
+        rows.  This comes from the <dimension> element that Excel writes at
+        the start of the sheet; when there is none, the rows are scanned.
+    */
+    static int64_t getLastRowIndex(std::streambuf * buf)
+    {
+        XmlPullParser parser(buf);
+
+        int64_t result = -1;
+        for (auto event = parser.next();  event != XmlPullParser::END_DOCUMENT;
+             event = parser.next()) {
+            if (event != XmlPullParser::START_ELEMENT)
+                continue;
+            if (parser.name() == "dimension") {
+                auto ref = parser.attr("ref");
+                if (!ref)
+                    continue;
+                // eg A1:C500; the row is the digits of the last cell
+                auto pos = ref->rfind(':');
+                string lastCell(*ref, pos == string::npos ? 0 : pos + 1);
+                size_t numLetters = 0;
+                while (numLetters < lastCell.size()
+                       && isalpha(lastCell[numLetters]))
+                    ++numLetters;
+                return CellValue::parse(lastCell.substr(numLetters)).toInt();
+            }
+            else if (parser.name() == "row") {
+                if (auto r = parser.attr("r"))
+                    result = std::max<int64_t>(result, CellValue::parse(*r).toInt());
+                else ++result;
+            }
+        }
 
-                Utf8String type = readAttr("t");
-                std::string cellid = readAttr("r").rawString();  // r stands for "reference"
-                Utf8String style = readAttr("s");
+        return result;
+    }
 
-                CellValue value;
-                Utf8String contents;
+    /** Call onRow for each row of the sheet in turn.  The row object is
+        reused from one call to the next.
+    */
+    void forEachRow(std::streambuf * buf,
+                    const std::function<void (Row & row)> & onRow) const
+    {
+        XmlPullParser parser(buf);
+
+        bool foundSheetData = false;
+        bool inSheetData = false;
+        bool inCell = false;
+        bool inValue = false;
+        bool hasValue = false;
+        std::string type;
+        std::string cellid;  // r stands for "reference"
+        std::string style;
+        std::string contents;
+
+        Row row;
+        row.index = 0;
+        int64_t colIndex = 0;
+
+        auto readAttr = [&] (const char * attr) -> std::string
+            {
+                const std::string * foundAttr = parser.attr(attr);
+                if (!foundAttr)
+                    return std::string();
+                return *foundAttr;
+            };
 
-                XMLNode * v = colNode->FirstChildElement("v");
-                XMLElement * ve = v ? v->ToElement(): nullptr;
+        for (auto event = parser.next();  event != XmlPullParser::END_DOCUMENT;
+             event = parser.next()) {
+            const std::string & name = parser.name();
 
-                if (ve) {
-                    if (ve->GetText())
-                        contents = ve->GetText();
+            if (event == XmlPullParser::TEXT) {
+                if (inValue)
+                    contents += parser.text();
+                continue;
+            }
 
-                    TRACE_MSG(logger) << "type = " << type;
-                    TRACE_MSG(logger) << "style = " << style;
+            if (!inSheetData) {
+                if (event == XmlPullParser::START_ELEMENT && name == "sheetData")
+                    foundSheetData = inSheetData = true;
+                continue;
+            }
 
-                    if (type == "s") {
-                        // shared string
-                        int index = std::stoi(contents.rawString());
-                        value = CellValue(strings.strings.at(index));
-                    }
-                    else if (!style.empty()) {
-                        int styleNum = CellValue::parse(style).toInt();
-                        const Styles::Style & style = styles.styles.at(styleNum);
-
-                        switch (style.repr) {
-                        case CellValue::TIMESTAMP: {
-                            double offset = CellValue::parse(contents).toDouble();
-                            value = workbook.baseDate.plusDays(offset);
-                            break;
-                        }
-                        case CellValue::TIMEINTERVAL: {
-                            uint16_t months = 0;
-                            uint16_t days = 0;
-                            uint16_t seconds = CellValue::parse(contents).toDouble();
-                            value = CellValue::fromMonthDaySecond(months, days, seconds);
-                            break;
-                        }
-                        case CellValue::FLOAT:  // fall through
-                        case CellValue::EMPTY: // fall through
-                            // These shouldn't occur
-                        case CellValue::INTEGER:
-                        case CellValue::ASCII_STRING:
-                        case CellValue::UTF8_STRING:
-                        default:
-                            value = CellValue::parse(contents);
-                        }
-                    }
-                    else if (type == "b" /* boolean */ || type.empty()) {
-                        // generic...
-                        value = CellValue::parse(contents);
-                    }
-                    else {
-                        // Probably a date... we should handle those
-                        INFO_MSG(logger) << "cell has unknown type";
-                        INFO_MSG(logger) << "type = " << type << " cellid = " << cellid
-                             << " s = " << style << " c " << contents;
-                    }
+            if (event == XmlPullParser::START_ELEMENT) {
+                if (name == "row") {
+                    // What is the row index?
+                    auto r = parser.attr("r");
+                    row.index = r ? CellValue::parse(*r).toInt() : row.index + 1;
+                    row.columns.clear();
+                    colIndex = 0;
                 }
-
-                // Get the column out of it
-                std::string columnPart;
-
-                if (cellid.empty()) {
-                    ++colIndex;
+                else if (name == "c") {
+                    inCell = true;
+                    hasValue = false;
+                    type = readAttr("t");
+                    cellid = readAttr("r");
+                    style = readAttr("s");
+                    contents.clear();
                 }
-                else {
-                    colIndex = 0;
-                    size_t numLetters = 0;
-                    while (numLetters < cellid.length() && isalpha(cellid[numLetters]))
-                        ++numLetters;
-                    if (numLetters == 1) {
-                        colIndex = toupper(cellid[0]) - 'A';
-                    }
-                    else if (numLetters == 2) {
-                        colIndex
-                            = (toupper(cellid[0]) - 'A' + 1) * 26
-                            + toupper(cellid[1]) - 'A';
-                    }
-                    else if (numLetters == 3) {
-                        colIndex
-                            = (toupper(cellid[0]) - 'A' + 1) * 26 * 26
-                            + (toupper(cellid[1]) - 'A' + 1) * 26
-                            + toupper(cellid[2]) - 'A';
-                    }
-                    else if (numLetters == 4) {
-                        colIndex
-                            = (toupper(cellid[0]) - 'A' + 1) * 26 * 26 * 26
-                            + (toupper(cellid[0]) - 'A' + 1) * 26 * 26
-                            + (toupper(cellid[1]) - 'A' + 1) * 26
-                            + toupper(cellid[2]) - 'A';
-                    }
-                    else throw AnnotatedException(400, "Unable to parse Cell ID '" + cellid + "'");
+                else if (inCell && name == "v") {
+                    inValue = hasValue = true;
+                }
+                else if (inCell && name == "is") {
+                    // Inline string, which may be rich text
+                    readStringItem(parser, contents);
+                    hasValue = true;
+                }
+            }
+            else {
+                if (name == "sheetData") {
+                    break;
+                }
+                else if (name == "v") {
+                    inValue = false;
+                }
+                else if (name == "c") {
+                    inCell = false;
+                    CellValue value;
+                    if (hasValue)
+                        value = getValue(type, cellid, style, contents);
+                    colIndex = getColIndex(cellid, colIndex);
+
+                    DEBUG_MSG(logger) << "cell " << cellid << " has value " << jsonEncodeStr(value);
+                    DEBUG_MSG(logger) << "row " << row.index << " column " << colIndex;
+                    row.columns.emplace_back(colIndex, std::move(value));
+                }
+                else if (name == "row") {
+                    onRow(row);
                 }
-
-                DEBUG_MSG(logger) << "cell " << cellid << " has value " << jsonEncodeStr(value);
-                DEBUG_MSG(logger) << "row " << rowIndex << " column " << colIndex;
-                row.columns.emplace_back(colIndex, std::move(value));
             }
-
-            rows.emplace_back(std::move(row));
         }
+
+        if (!foundSheetData)
+            throw AnnotatedException(400, "xlsx worksheet has no sheetData element");
     }
 
-    struct Row {
-        int64_t index;   ///< Row index, 1-based
-        std::vector<std::tuple<int64_t, CellValue> > columns;
-    };
+    CellValue getValue(const std::string & type,
+                       const std::string & cellid,
+                       const std::string & style,
+                       const std::string & contents) const
+    {
+        TRACE_MSG(logger) << "type = " << type;
+        TRACE_MSG(logger) << "style = " << style;
+
+        if (type == "s") {
+            // shared string
+            return strings.get(std::stoll(contents));
+        }
+        else if (type == "inlineStr" || type == "str") {
+            // string held in the cell, or the string result of a formula
+            return CellValue(Utf8String(contents));
+        }
+        else if (!style.empty()) {
+            int styleNum = CellValue::parse(style).toInt();
+            const Styles::Style & style = styles.styles.at(styleNum);
+
+            switch (style.repr) {
+            case CellValue::TIMESTAMP: {
+                double offset = CellValue::parse(contents).toDouble();
+                return workbook.baseDate.plusDays(offset);
+            }
+            case CellValue::TIMEINTERVAL: {
+                uint16_t months = 0;
+                uint16_t days = 0;
+                uint16_t seconds = CellValue::parse(contents).toDouble();
+                return CellValue::fromMonthDaySecond(months, days, seconds);
+            }
+            case CellValue::FLOAT:  // fall through
+            case CellValue::EMPTY: // fall through
+                // These shouldn't occur
+            case CellValue::INTEGER:
+            case CellValue::ASCII_STRING:
+            case CellValue::UTF8_STRING:
+            default:
+                return CellValue::parse(contents);
+            }
+        }
+        else if (type == "b" /* boolean */ || type.empty()) {
+            // generic...
+            return CellValue::parse(contents);
+        }
 
-    vector<Row> rows;
+        // Probably a date... we should handle those
+        INFO_MSG(logger) << "cell has unknown type";
+        INFO_MSG(logger) << "type = " << type << " cellid = " << cellid
+                         << " s = " << style << " c " << contents;
+        return CellValue();
+    }
 
-}; // struct Sheet
+    /// Get the column out of the cell reference, eg 2 for C10
+    static int64_t getColIndex(const std::string & cellid,
+                               int64_t previousColIndex)
+    {
+        if (cellid.empty())
+            return previousColIndex + 1;
+
+        size_t numLetters = 0;
+        while (numLetters < cellid.length() && isalpha(cellid[numLetters]))
+            ++numLetters;
+        if (numLetters == 1) {
+            return toupper(cellid[0]) - 'A';
+        }
+        else if (numLetters == 2) {
+            return (toupper(cellid[0]) - 'A' + 1) * 26
+                + toupper(cellid[1]) - 'A';
+        }
+        else if (numLetters == 3) {
+            return (toupper(cellid[0]) - 'A' + 1) * 26 * 26
+                + (toupper(cellid[1]) - 'A' + 1) * 26
+                + toupper(cellid[2]) - 'A';
+        }
+        else if (numLetters == 4) {
+            return (toupper(cellid[0]) - 'A' + 1) * 26 * 26 * 26
+                + (toupper(cellid[0]) - 'A' + 1) * 26 * 26
+                + (toupper(cellid[1]) - 'A' + 1) * 26
+                + toupper(cellid[2]) - 'A';
+        }
+        else throw AnnotatedException(400, "Unable to parse Cell ID '" + cellid + "'");
+    }
+}; // struct SheetReader
 
 struct XlsxImporter: public Procedure {
 
@@ -686,6 +756,7 @@ struct XlsxImporter: public Procedure {
         Styles styles;
         std::string savedRelationships;
         bool sheetsLoaded = false;
+        bool hasSharedStrings = false;
         auto runProcConf = applyRunConfOverProcConf(config, run);
 
         workbook.timestamp = Date::positiveInfinity();
@@ -713,7 +784,7 @@ struct XlsxImporter: public Procedure {
                     //
                     //     Note that some Excel files have no shared strings table.
 
-                    strings.load(open({}).buf, logger);
+                    hasSharedStrings = true;
                 }
                 else if (internalFilename == "xl/workbook.xml") {
                     // 2.  Load up the workbook, which tells us what our sheets
@@ -743,9 +814,17 @@ struct XlsxImporter: public Procedure {
                 return true;
             };
 
-        forEachUriObject(
-            "archive+" + runProcConf.dataFileUrl.toDecodedString(),
-            onFile);
+        std::string archiveUri
+            = "archive+" + runProcConf.dataFileUrl.toDecodedString();
+
+        forEachUriObject(archiveUri, onFile);
+
+        // The shared strings can be large, so they are streamed out of the
+        // archive rather than read whole from within the listing
+        if (hasSharedStrings) {
+            filter_istream stream(archiveUri + "#xl/sharedStrings.xml");
+            strings.load(stream.rdbuf(), logger);
+        }
 
         // Create the output dataset
 
@@ -756,56 +835,93 @@ struct XlsxImporter: public Procedure {
             output = obtainDataset(engine, runProcConf.output);
         }
 
-        // 4.  Load the worksheets, one by one
-        for (auto & sheetEntry: workbook.sheets) {
-            Utf8String filename =
-                "archive+" + runProcConf.dataFileUrl.toDecodedString()
-                + "#xl/" + sheetEntry.filename;
-            filter_istream sheetStream(filename.rawString());
+        if (!output)
+            return RunOutput();
+
+        auto getColName = [] (int64_t colIndex)
+            {
+                string result;
+
+                if (colIndex < 26) {
+                    result = char('A' + (colIndex));
+                }
+                else {
+                    result = char('A' + (colIndex % 26)) + result;
+                    colIndex /= 26;
+                    while (colIndex) {
+                        result = char('A' + (colIndex % 26) - 1) + result;
+                        colIndex /= 26;
+                    }
+                }
 
-            Sheet sheet(sheetStream.rdbuf(), workbook, strings, styles, logger);
+                return ColumnPath(result);
+            };
 
-            DEBUG_MSG(logger) << "sheet had " << sheet.rows.size() << " rows";
+        // 4.  Load the worksheets in parallel, each one streamed from the
+        //     archive and recorded in chunks as its rows are read
+        static constexpr size_t ROWS_PER_CHUNK = 65536;
+        SheetReader reader(workbook, strings, styles, logger);
+        auto recorder = output->getChunkRecorder();
+        std::atomic<size_t> numChunks(0);
 
-            auto getColName = [] (int64_t colIndex)
+        auto doSheet = [&] (size_t i)
+            {
+                const Workbook::Sheet & sheetEntry = workbook.sheets[i];
+                std::string filename
+                    = archiveUri + "#xl/" + sheetEntry.filename.rawString();
+
+                // The width of the row numbers in the row names depends on
+                // the last row, which needs to be known before the first
+                // one is recorded
+                int64_t maxRowIndex;
                 {
-                    string result;
+                    filter_istream stream(filename);
+                    maxRowIndex = SheetReader::getLastRowIndex(stream.rdbuf());
+                }
+                int indexLength = MLDB::format("%lld", (long long)maxRowIndex).length();
 
-                    if (colIndex < 26) {
-                        result = char('A' + (colIndex));
-                    }
-                    else {
-                        result = char('A' + (colIndex % 26)) + result;
-                        colIndex /= 26;
-                        while (colIndex) {
-                            result = char('A' + (colIndex % 26) - 1) + result;
-                            colIndex /= 26;
+                std::unique_ptr<Recorder> chunk;
+                size_t rowsInChunk = 0;
+                size_t numRows = 0;
+
+                auto onRow = [&] (SheetReader::Row & row)
+                    {
+                        if (!chunk)
+                            chunk = recorder.newChunk(numChunks.fetch_add(1));
+
+                        RowPath rowName(sheetEntry.name + MLDB::format(":%0*lld", indexLength, (long long)row.index));
+
+                        std::vector<std::tuple<ColumnPath, CellValue, Date> > columns;
+                        columns.reserve(row.columns.size());
+                        for (auto & col: row.columns) {
+                            columns.emplace_back(getColName(std::get<0>(col)),
+                                                 std::move(std::get<1>(col)),
+                                                 workbook.timestamp);
                         }
-                    }
 
-                    return ColumnPath(result);
-                };
+                        chunk->recordRow(rowName, columns);
+                        ++numRows;
 
-            if (output && !sheet.rows.empty()) {
-                int maxRowIndex = sheet.rows.back().index;
-                int indexLength = MLDB::format("%d", maxRowIndex).length();
+                        if (++rowsInChunk == ROWS_PER_CHUNK) {
+                            chunk->finishedChunk();
+                            chunk.reset();
+                            rowsInChunk = 0;
+                        }
+                    };
 
-                for (auto & row: sheet.rows) {
-                    MatrixNamedRow outputRow;
-                    outputRow.rowHash = outputRow.rowName
-                        = RowPath(sheetEntry.name + MLDB::format(":%0*d", indexLength, row.index));
+                filter_istream sheetStream(filename);
+                reader.forEachRow(sheetStream.rdbuf(), onRow);
 
-                    for (auto & col: row.columns) {
-                        outputRow.columns.emplace_back(getColName(std::get<0>(col)),
-                                                       std::get<1>(col),
-                                                       workbook.timestamp);
-                    }
+                if (chunk)
+                    chunk->finishedChunk();
 
-                    output->recordRow(outputRow.rowName, outputRow.columns);
-                }
-            }
-        }
-        output->commit();
+                DEBUG_MSG(logger) << "sheet " << sheetEntry.name << " had "
+                                  << numRows << " rows";
+            };
+
+        parallelMap(0, workbook.sheets.size(), doSheet);
+
+        recorder.commit();
         return RunOutput();
     }
 
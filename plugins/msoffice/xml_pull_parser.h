@@ -0,0 +1,398 @@
+/** xml_pull_parser.h                                              -*- C++ -*-
+    This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
+
+    Streaming XML tokenizer used by the Excel importer.
+*/
+
+#pragma once
+
+#include "mldb/types/annotated_exception.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cctype>
+
+namespace MLDB {
+
+/*****************************************************************************/
+/* XML PULL PARSER                                                           */
+/*****************************************************************************/
+
+/** Streaming XML tokenizer for the parts of a workbook that can be large
+    (the sheets and the shared strings table), so that they can be read
+    straight out of the archive without building a document in memory.
+
+    It handles what SpreadsheetML uses: elements, attributes, text,
+    predefined and character entities, CDATA sections and comments.
+    Processing instructions and DTDs are skipped.  Element and attribute
+    names are returned without their namespace prefix, and an empty
+    element returns both a start and an end event.  Text may be returned
+    as several consecutive TEXT events.
+*/
+struct XmlPullParser {
+
+    enum Event {
+        START_ELEMENT,
+        END_ELEMENT,
+        TEXT,
+        END_DOCUMENT
+    };
+
+    XmlPullParser(std::streambuf * buf)
+        : buf(buf)
+    {
+    }
+
+    /// Read the next event
+    Event next()
+    {
+        if (pendingEnd) {
+            pendingEnd = false;
+            return END_ELEMENT;
+        }
+
+        text_.clear();
+
+        for (;;) {
+            int c = buf->sgetc();
+            if (c == EOF)
+                return text_.empty() ? END_DOCUMENT : TEXT;
+
+            if (c == '&') {
+                buf->sbumpc();
+                readEntity(text_);
+                continue;
+            }
+
+            if (c != '<') {
+                text_ += (char)buf->sbumpc();
+                continue;
+            }
+
+            if (!text_.empty())
+                return TEXT;
+
+            buf->sbumpc();
+            c = buf->sgetc();
+
+            if (c == '?') {
+                skipPast("?>");
+            }
+            else if (c == '!') {
+                buf->sbumpc();
+                if (buf->sgetc() == '-') {
+                    skipPast("-->");
+                }
+                else if (buf->sgetc() == '[') {
+                    expect("[CDATA[");
+                    readCdata(text_);
+                }
+                else {
+                    skipDeclaration();
+                }
+            }
+            else if (c == '/') {
+                buf->sbumpc();
+                readName(name_);
+                skipWhitespace();
+                expect(">");
+                return END_ELEMENT;
+            }
+            else {
+                readName(name_);
+                readAttributes();
+                return START_ELEMENT;
+            }
+        }
+    }
+
+    /// Name of the element of the current start or end event
+    const std::string & name() const
+    {
+        return name_;
+    }
+
+    /// Text of the current text event, with entities decoded
+    const std::string & text() const
+    {
+        return text_;
+    }
+
+    /// Value of the given attribute of the current start element, or null
+    const std::string * attr(const char * name) const
+    {
+        for (size_t i = 0;  i < numAttrs;  ++i) {
+            if (attrs[i].first == name)
+                return &attrs[i].second;
+        }
+        return nullptr;
+    }
+
+    /// Throw the error for a document that ends in the middle of a token
+    [[noreturn]] static void unexpectedEnd()
+    {
+        throw AnnotatedException(400, "xlsx XML document ended unexpectedly");
+    }
+
+private:
+    std::streambuf * buf;
+    std::string name_;
+    std::string text_;
+    std::vector<std::pair<std::string, std::string> > attrs;  ///< Reused
+    size_t numAttrs = 0;
+    bool pendingEnd = false;  ///< Current start element was empty
+
+    void expect(const char * str)
+    {
+        for (;  *str;  ++str) {
+            int c = buf->sbumpc();
+            if (c == EOF)
+                unexpectedEnd();
+            if (c != *str)
+                throw AnnotatedException(400, "Error parsing xlsx XML document",
+                                         "expected", std::string(1, *str),
+                                         "got", std::string(1, (char)c));
+        }
+    }
+
+    void skipPast(const char * terminator)
+    {
+        size_t len = strlen(terminator);
+        size_t matched = 0;
+        while (matched < len) {
+            int c = buf->sbumpc();
+            if (c == EOF)
+                unexpectedEnd();
+            if (c == terminator[matched])
+                ++matched;
+            else matched = (c == terminator[0]);
+        }
+    }
+
+    void skipDeclaration()
+    {
+        // <!DOCTYPE ...> and friends, which may have an internal subset
+        // in square brackets
+        int depth = 0;
+        for (;;) {
+            int c = buf->sbumpc();
+            if (c == EOF)
+                unexpectedEnd();
+            if (c == '[')
+                ++depth;
+            else if (c == ']')
+                --depth;
+            else if (c == '>' && depth <= 0)
+                return;
+        }
+    }
+
+    /// Append the contents of a CDATA section, up to its "]]>", to out
+    void readCdata(std::string & out)
+    {
+        // Only look for the terminator in this section, not in text that
+        // was already in out
+        size_t start = out.length();
+        for (;;) {
+            int c = buf->sbumpc();
+            if (c == EOF)
+                unexpectedEnd();
+            out += (char)c;
+            size_t len = out.length();
+            if (c == '>' && len >= start + 3
+                && out[len - 2] == ']' && out[len - 3] == ']') {
+                out.resize(len - 3);
+                return;
+            }
+        }
+    }
+
+    void skipWhitespace()
+    {
+        while (isspace(buf->sgetc()))
+            buf->sbumpc();
+    }
+
+    void readName(std::string & name)
+    {
+        name.clear();
+        for (;;) {
+            int c = buf->sgetc();
+            if (c == EOF)
+                unexpectedEnd();
+            if (isspace(c) || c == '>' || c == '/' || c == '=')
+                break;
+            buf->sbumpc();
+            if (c == ':')
+                name.clear();  // drop the namespace prefix
+            else name += (char)c;
+        }
+        if (name.empty())
+            throw AnnotatedException(400, "Error parsing xlsx XML document: "
+                                     "expected a name");
+    }
+
+    void readAttributes()
+    {
+        numAttrs = 0;
+        for (;;) {
+            skipWhitespace();
+            int c = buf->sgetc();
+            if (c == EOF)
+                unexpectedEnd();
+            if (c == '>') {
+                buf->sbumpc();
+                return;
+            }
+            if (c == '/') {
+                buf->sbumpc();
+                expect(">");
+                pendingEnd = true;
+                return;
+            }
+
+            if (numAttrs == attrs.size())
+                attrs.emplace_back();
+            auto & attr = attrs[numAttrs++];
+            readName(attr.first);
+            skipWhitespace();
+            expect("=");
+            skipWhitespace();
+
+            int quote = buf->sbumpc();
+            if (quote != '"' && quote != '\'')
+                throw AnnotatedException(400, "Error parsing xlsx XML document: "
+                                         "attribute value is not quoted",
+                                         "attribute", attr.first);
+            attr.second.clear();
+            while ((c = buf->sbumpc()) != quote) {
+                if (c == EOF)
+                    unexpectedEnd();
+                if (c == '&')
+                    readEntity(attr.second);
+                else attr.second += (char)c;
+            }
+        }
+    }
+
+    /// Decode the entity following a '&', appending it to out
+    void readEntity(std::string & out)
+    {
+        char entity[16];
+        size_t len = 0;
+        for (;;) {
+            int c = buf->sbumpc();
+            if (c == EOF)
+                unexpectedEnd();
+            if (c == ';')
+                break;
+            if (len == sizeof(entity) - 1)
+                throw AnnotatedException(400, "Error parsing xlsx XML document: "
+                                         "entity reference is too long");
+            entity[len++] = c;
+        }
+        entity[len] = 0;
+
+        if (entity[0] == '#') {
+            bool hex = entity[1] == 'x';
+            const char * digits = entity + 1 + hex;
+            // strtoul would also accept whitespace and a sign
+            char * end = nullptr;
+            unsigned long code = 0;
+            if (hex ? isxdigit(digits[0]) : isdigit(digits[0]))
+                code = strtoul(digits, &end, hex ? 16 : 10);
+            if (!end || *end || code == 0 || code > 0x10ffff
+                || (code >= 0xd800 && code < 0xe000))
+                throw AnnotatedException(400, "Error parsing xlsx XML document: "
+                                         "invalid character reference",
+                                         "entity", std::string(entity));
+            appendUtf8(out, code);
+        }
+        else if (!strcmp(entity, "amp"))
+            out += '&';
+        else if (!strcmp(entity, "lt"))
+            out += '<';
+        else if (!strcmp(entity, "gt"))
+            out += '>';
+        else if (!strcmp(entity, "quot"))
+            out += '"';
+        else if (!strcmp(entity, "apos"))
+            out += '\'';
+        else throw AnnotatedException(400, "Error parsing xlsx XML document: "
+                                      "unknown entity",
+                                      "entity", std::string(entity));
+    }
+
+    static void appendUtf8(std::string & out, unsigned long code)
+    {
+        if (code < 0x80) {
+            out += (char)code;
+        }
+        else if (code < 0x800) {
+            out += (char)(0xc0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3f));
+        }
+        else if (code < 0x10000) {
+            out += (char)(0xe0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3f));
+            out += (char)(0x80 | (code & 0x3f));
+        }
+        else {
+            out += (char)(0xf0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3f));
+            out += (char)(0x80 | ((code >> 6) & 0x3f));
+            out += (char)(0x80 | (code & 0x3f));
+        }
+    }
+};
+
+
+/** Read the text of a SpreadsheetML string item (an <si> element of the
+    shared strings table, or the <is> element of an inline string cell),
+    whose start element was the last event read from parser, appending it
+    to out.  This reads up to and including the item's end element.
+
+    The text is the concatenation of its <t> elements, which are either
+    directly in the item or in rich text runs (<r>).  Phonetic hints for
+    East Asian text (<rPh>) aren't part of it.
+*/
+inline void readStringItem(XmlPullParser & parser, std::string & out)
+{
+    int depth = 0;
+    int phoneticDepth = 0;
+    bool inText = false;
+
+    for (;;) {
+        switch (parser.next()) {
+        case XmlPullParser::START_ELEMENT:
+            ++depth;
+            if (parser.name() == "rPh")
+                ++phoneticDepth;
+            else if (parser.name() == "t")
+                inText = phoneticDepth == 0;
+            break;
+
+        case XmlPullParser::END_ELEMENT:
+            if (depth-- == 0)
+                return;
+            if (parser.name() == "rPh")
+                --phoneticDepth;
+            else if (parser.name() == "t")
+                inText = false;
+            break;
+
+        case XmlPullParser::TEXT:
+            if (inText)
+                out += parser.text();
+            break;
+
+        case XmlPullParser::END_DOCUMENT:
+            XmlPullParser::unexpectedEnd();
+        }
+    }
+}
+
+} // namespace MLDB
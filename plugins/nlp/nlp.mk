@@ -13,6 +13,7 @@ LIBMLDB_NLP_PLUGIN_SOURCES:= \
 
 
 LIBMLDB_NLP_PLUGIN_LINK:= \
+	string_counts_table \
 
 $(eval $(call library,mldb_nlp_plugin,$(LIBMLDB_NLP_PLUGIN_SOURCES),$(LIBMLDB_NLP_PLUGIN_LINK)))
 
@@ -26,6 +26,7 @@
 #include "mldb/builtin/sql_config_validator.h"
 #include "mldb/utils/log.h"
 #include "mldb/types/db/persistent.h"
+#include "mldb/base/per_thread_accumulator.h"
 
 using namespace std;
 
@@ -33,23 +34,22 @@ namespace {
 void
 serialize(MLDB::DB::Store_Writer & store,
           uint64_t corpusSize,
-          const std::unordered_map<MLDB::Utf8String, uint64_t> & dfs)
+          const MLDB::StringCountsTable & dfs)
 {
+    // Version 1 replaced the list of (term, count) pairs by a
+    // StringCountsTable, which can be used in place from a mapped file
     std::string name = "tfidf";
-    int version = 0;
+    int version = 1;
     store << name << version;
     store << corpusSize; // number of documents in corpus
-    store << dfs.size(); // number of terms in corpus
-    for (auto & df : dfs) {
-        store << df.first.rawString();
-        store << df.second;
-    }
+    dfs.serialize(store);
 }
 
 void
 reconstitute(MLDB::DB::Store_Reader & store,
              uint64_t & corpusSize,
-             std::unordered_map<MLDB::Utf8String, uint64_t> & dfs)
+             MLDB::StringCountsTable & dfs,
+             std::shared_ptr<const void> mapping)
 {
     std::string name;
     store >> name;
@@ -58,28 +58,36 @@ reconstitute(MLDB::DB::Store_Reader & store,
 
     int version;
     store >> version;
-    if (version != 0)
+    if (version != 0 && version != 1)
         throw MLDB::Exception("invalid tf-idf version");
 
-    uint64_t termCount = 0;
-
     store >> corpusSize; // number of documents in corpus
+
+    if (version == 1) {
+        dfs.reconstitute(store, std::move(mapping));
+        if (dfs.numCounts() != 1)
+            throw MLDB::Exception("invalid tf-idf document frequency table");
+        return;
+    }
+
+    uint64_t termCount = 0;
     store >> termCount; // number of terms in corpus
-    dfs.clear();
-    dfs.reserve(termCount);
+    dfs = MLDB::StringCountsTable(1);
     for (int i=0; i < termCount; ++i) {
         std::string term;
-        uint64_t df;
+        int64_t df;
         store >> term;
         store >> df;
-        dfs[term] = df;
+        dfs.add(term.data(), term.size(),
+                MLDB::StringCountsTable::hashKey(term.data(), term.size()),
+                &df);
     }
 }
 
 void
 save(const std::string & filename,
      uint64_t corpusSize,
-     const std::unordered_map<MLDB::Utf8String, uint64_t> & dfs)
+     const MLDB::StringCountsTable & dfs)
 {
     MLDB::filter_ostream stream(filename);
     MLDB::DB::Store_Writer store(stream);
@@ -87,13 +95,13 @@ save(const std::string & filename,
 }
 
 void
-load(const std::string & filename,
+load(const MLDB::Url & url,
      uint64_t & corpusSize,
-     std::unordered_map<MLDB::Utf8String, uint64_t> & dfs)
+     MLDB::StringCountsTable & dfs)
 {
-    MLDB::filter_istream stream(filename);
-    MLDB::DB::Store_Reader store(stream);
-    reconstitute(store, corpusSize, dfs);
+    MLDB::DB::Store_Reader store;
+    auto mapping = MLDB::openStringCountsTableFile(url, store);
+    reconstitute(store, corpusSize, dfs, std::move(mapping));
 }
 }
 
@@ -198,16 +206,24 @@ run(const ProcedureRunConfig & run,
     ConvertProgressToJson convertProgressToJson(onProgress);
     auto boundDataset = runProcConf.trainingData.stm->from->bind(context, convertProgressToJson);
 
-    //This will cummulate the number of documents each word is in
-    std::unordered_map<Utf8String, uint64_t> dfs;
+    // This will cummulate the number of documents each word is in.  Each
+    // thread counts into its own table; they are summed at the end by
+    // StringCountsTable::merge, which merges disjoint hash partitions in
+    // parallel.
+    PerThreadAccumulator<StringCountsTable> threadDfs
+        ([] () { return new StringCountsTable(1); });
     std::atomic<uint64_t> corpusSize(0);
 
     auto processor = [&] (NamedRowValue & row_)
         {
             MatrixNamedRow row = row_.flattenDestructive();
+            StringCountsTable & dfs = threadDfs.get();
             for (auto& col : row.columns) {
                 Utf8String word = get<0>(col).toUtf8String();
-                dfs[word] += 1;
+                dfs.insert(word.rawData(), word.rawLength(),
+                           StringCountsTable::hashKey(word.rawData(),
+                                                      word.rawLength()))[0]
+                    += 1;
             }
             ++corpusSize;
 
@@ -217,12 +233,19 @@ run(const ProcedureRunConfig & run,
     iterateDataset(runProcConf.trainingData.stm->select, *boundDataset.dataset, boundDataset.asName,
                    runProcConf.trainingData.stm->when,
                    *runProcConf.trainingData.stm->where,
-                   {processor,false/*processInParallel*/},
+                   {processor,true/*processInParallel*/},
                    runProcConf.trainingData.stm->orderBy,
                    runProcConf.trainingData.stm->offset,
                    runProcConf.trainingData.stm->limit,
                    convertProgressToJson);
 
+    std::vector<const StringCountsTable *> shards;
+    threadDfs.forEach([&] (StringCountsTable * shard)
+                      {
+                          shards.push_back(shard);
+                      });
+    StringCountsTable dfs = StringCountsTable::merge(shards, 1);
+
     bool saved = false;
     if (!runProcConf.modelFileUrl.empty()) {
         try {
@@ -248,11 +271,22 @@ run(const ProcedureRunConfig & run,
         Date applyDate = Date::now();
         ColumnPath columnName(PathElement("count"));
 
-        for (auto & df : dfs) {
-            std::vector<std::tuple<ColumnPath, CellValue, Date> > columns;
-            columns.emplace_back(columnName, df.second, applyDate);
-            output->recordRow(PathElement(df.first), columns);
-        }
+        typedef std::vector<std::tuple<ColumnPath, CellValue, Date> > Columns;
+
+        auto onTermChunk = [&] (size_t i0, size_t i1)
+        {
+            std::vector<std::pair<RowPath, Columns> > rows;
+            rows.reserve(i1 - i0);
+            for (size_t i = i0; i < i1; ++i) {
+                Utf8String term(std::string(dfs.keyData(i), dfs.keyLength(i)));
+                Columns columns;
+                columns.emplace_back(columnName, dfs.counts(i)[0], applyDate);
+                rows.emplace_back(PathElement(term), std::move(columns));
+            }
+            output->recordRows(rows);
+        };
+
+        parallelMapChunked(0, dfs.size(), 1024 /* chunksize */, onTermChunk);
         output->commit();
     }
 
@@ -314,7 +348,29 @@ TfidfFunction(MldbEngine * owner,
     : Function(owner, config)
 {
     functionConfig = config.params.convert<TfidfFunctionConfig>();
-    load(functionConfig.modelFileUrl.toString(), corpusSize, dfs);
+
+    // The model itself is loaded on first use, but a missing file is
+    // reported straight away
+    if (!tryGetUriObjectInfo(functionConfig.modelFileUrl.toDecodedString())) {
+        throw AnnotatedException(400, "tf-idf model file '"
+                                 + functionConfig.modelFileUrl.toString()
+                                 + "' does not exist",
+                                 "modelFileUrl",
+                                 functionConfig.modelFileUrl.toString());
+    }
+}
+
+const TfidfFunction::Model &
+TfidfFunction::
+getModel() const
+{
+    std::call_once(modelLoaded, [&] ()
+        {
+            auto loaded = std::make_unique<Model>();
+            load(functionConfig.modelFileUrl, loaded->corpusSize, loaded->dfs);
+            model = std::move(loaded);
+        });
+    return *model;
 }
 
 Any
@@ -331,20 +387,27 @@ apply(const FunctionApplier & applier,
 {
     ExpressionValue result;
 
+    const Model & model = getModel();
+    const uint64_t corpusSize = model.corpusSize;
+
     ExpressionValue inputVal = context.getColumn(PathElement("input"));
     
     uint64_t maxFrequency = 0; // max term frequency for the current document
     uint64_t maxNt = 0;        // max document frequency for terms in the current doc
 
+    // Document frequency of each input term, in column order, so that each
+    // term is only looked up once
+    std::vector<uint64_t> termDfs;
+
     auto onColumn = [&] (const PathElement & name,
                          const ExpressionValue & val)
         {
             Utf8String term = name.toUtf8String();
             uint64_t value = val.getAtom().toUInt();
             maxFrequency = std::max(value, maxFrequency);
-            const auto termFrequency = dfs.find(term);
-            if (termFrequency != dfs.end())
-                maxNt = std::max(maxNt, termFrequency->second); 
+            uint64_t nt = model.dfs.get(term.rawData(), term.rawLength())[0];
+            maxNt = std::max(maxNt, nt);
+            termDfs.push_back(nt);
             return true;
         };
 
@@ -419,19 +482,18 @@ apply(const FunctionApplier & applier,
     // Compute the score for every word in the input
     DEBUG_MSG(logger) << "corpus size: " << corpusSize;
 
+    size_t termNum = 0;
     auto onColumn2 = [&] (const PathElement & name,
                           const ExpressionValue & val)
         {
-            Utf8String term = name.toUtf8String();
             double frequency = val.getAtom().toDouble();
 
             double tf = tf_fct(frequency);
-            const auto docFrequency = dfs.find(term);
-            uint64_t docFrequencyInt = docFrequency != dfs.end() ? docFrequency->second : 0;
+            uint64_t docFrequencyInt = termDfs.at(termNum++);
             double idf = idf_fct(docFrequencyInt);
 
             DEBUG_MSG(logger)
-                << "term: '" << term << "', df: "
+                << "term: '" << name << "', df: "
                 << docFrequencyInt << ", tf: " << tf << ", idf: " << idf;
 
             values.emplace_back(name, tf*idf, ts);
@@ -13,7 +13,9 @@
 #include "mldb/core/procedure.h"
 #include "mldb/core/function.h"
 #include "mldb/types/optional.h"
-#include <unordered_map>
+#include "mldb/utils/string_counts_table.h"
+#include <memory>
+#include <mutex>
 
 
 namespace MLDB {
@@ -101,9 +103,22 @@ struct TfidfFunction: public Function {
     virtual FunctionInfo getFunctionInfo() const;
 
     TfidfFunctionConfig functionConfig;
-    // document frequencies for terms
-    std::unordered_map<Utf8String, uint64_t> dfs;
-    uint64_t corpusSize;
+
+    struct Model {
+        uint64_t corpusSize = 0;
+        // document frequencies for terms, with a single count per term
+        StringCountsTable dfs;
+    };
+
+    /** Return the model, loading it on first use.  The vocabulary can be
+        very large, so it's only read (or memory mapped) once the function
+        is actually applied.
+    */
+    const Model & getModel() const;
+
+private:
+    mutable std::once_flag modelLoaded;
+    mutable std::unique_ptr<Model> model;
 };
 
 } // namespace MLDB
@@ -201,6 +201,11 @@ struct Word2VecImporter: public Procedure {
         auto namedBound = config.named->bind(scope);
 
         for (unsigned i = 0;  i < numWords;  ++i) {
+            // The word2vec tool writes a newline after each vector, which
+            // isn't part of the next word
+            while (stream.peek() == '\n' || stream.peek() == '\r')
+                stream.get();
+
             std::string word;
             getline(stream, word, ' ');
 
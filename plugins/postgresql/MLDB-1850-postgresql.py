@@ -86,6 +86,36 @@ expected = [["_rowName","a","b","c"],
 
 assert res == expected
 
+mldb.log("From Postgres to MLDB in parallel")
+
+res = mldb.post('/v1/procedures', {
+    'type': 'postgresql.import',
+    'params': {
+        'databaseName' : 'mldb',
+        'port' : 5432,
+        'postgresqlQuery' : 'select * from mytable',
+        'partitionKey' : 'b',
+        'numPartitions' : 2,
+        'runOnCreation': True,
+        'outputDataset' : {
+                    'id' : 'out_parallel',
+                    'type' : 'tabular'
+                }
+    }
+})
+
+mldb.log(res)
+
+res = mldb.query("select * from out_parallel order by rowName()")
+
+mldb.log(res)
+
+expected = [["_rowName","a","b","c"],
+            ["row_0_0","alfalfa",1,3.5],
+            ["row_1_0","brigade",2,5.7]]
+
+assert res == expected
+
 mldb.log("Query Function")
 mldb.put('/v1/functions/query_from_postgres', {
     'type': 'postgresql.query',
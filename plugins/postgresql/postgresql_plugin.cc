@@ -7,12 +7,21 @@
 #include "mldb/core/procedure.h"
 #include "mldb/core/function.h"
 #include "mldb/core/dataset.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/sql/sql_utils.h"
 #include "mldb/credentials/credentials.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/any_impl.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/base/scope.h"
 
 #include <postgresql/libpq-fe.h>
 
+#include <endian.h>
+#include <atomic>
+#include <cstring>
+#include <mutex>
 #include <unordered_set>
 
 using namespace std;
@@ -43,6 +52,8 @@ const int postgresqlDefaultPort = 5432;
 namespace {
 CellValue getCellValueFromPostgres(const PGresult *res, int i, int j)
 {
+    if (PQgetisnull(res, i, j))
+        return CellValue();
     int postgrestype = PQftype(res, j);
     if (postgrestype == 23) {
         return CellValue(atoi(PQgetvalue(res, i, j)));
@@ -80,8 +91,481 @@ pg_conn* startPostgresqlConnection(const string& databaseName, const string& hos
     return conn;
 }
 
+/// Quote an identifier, so that it can be used in a query whatever its name
+string quotePostgresqlIdentifier(const string & name)
+{
+    string result = "\"";
+    for (char c: name) {
+        if (c == '"')
+            result += '"';
+        result += c;
+    }
+    return result + "\"";
+}
+
+// Type OIDs of the types that are read in binary form; all other types are
+// read as text, as their binary form is either internal or not useful.
+enum {
+    PG_INT8 = 20,
+    PG_INT2 = 21,
+    PG_INT4 = 23,
+    PG_FLOAT4 = 700,
+    PG_FLOAT8 = 701,
+    PG_TIMESTAMP = 1114,
+    PG_TIMESTAMPTZ = 1184
+};
+
+bool isPostgresqlBinaryType(Oid type)
+{
+    switch (type) {
+    case PG_INT8:
+    case PG_INT2:
+    case PG_INT4:
+    case PG_FLOAT4:
+    case PG_FLOAT8:
+    case PG_TIMESTAMP:
+    case PG_TIMESTAMPTZ:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/** Decode a field in the binary format of the given type, or as text if
+    it's not one of the binary types.  A negative length is a NULL.
+*/
+CellValue getCellValueFromPostgresBinary(Oid type, const char * data, int32_t len)
+{
+    if (len < 0)
+        return CellValue();
+
+    auto read = [&] (auto & val)
+        {
+            if (len != sizeof(val))
+                throw AnnotatedException(500, "Unexpected length for binary "
+                                         "PostgreSQL value",
+                                         "type", type, "length", len);
+            std::memcpy(&val, data, sizeof(val));
+        };
+
+    switch (type) {
+    case PG_INT2: {
+        uint16_t val;  read(val);
+        return CellValue((int16_t)be16toh(val));
+    }
+    case PG_INT4: {
+        uint32_t val;  read(val);
+        return CellValue((int32_t)be32toh(val));
+    }
+    case PG_INT8: {
+        uint64_t val;  read(val);
+        return CellValue((int64_t)be64toh(val));
+    }
+    case PG_FLOAT4: {
+        uint32_t val;  read(val);
+        val = be32toh(val);
+        float f;  std::memcpy(&f, &val, sizeof(f));
+        return CellValue(f);
+    }
+    case PG_FLOAT8: {
+        uint64_t val;  read(val);
+        val = be64toh(val);
+        double d;  std::memcpy(&d, &val, sizeof(d));
+        return CellValue(d);
+    }
+    case PG_TIMESTAMP:
+    case PG_TIMESTAMPTZ: {
+        // Microseconds since 2000-01-01 00:00:00 UTC
+        uint64_t val;  read(val);
+        int64_t micros = be64toh(val);
+        return CellValue(Date::fromSecondsSinceEpoch(946684800.0
+                                                     + micros / 1000000.0));
+    }
+    default:
+        return CellValue(data, len);
+    }
+}
+
+/** Return the names and types of the columns that a query returns, without
+    running it.
+*/
+std::vector<std::pair<string, Oid> >
+describePostgresqlQuery(pg_conn * conn, const string & query)
+{
+    auto res = PQprepare(conn, "", query.c_str(), 0, nullptr);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        string errorMsg(PQresultErrorMessage(res));
+        PQclear(res);
+        throw AnnotatedException(400, "Could not prepare PostgreSQL query: "
+                                 + errorMsg);
+    }
+    PQclear(res);
+
+    res = PQdescribePrepared(conn, "");
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        string errorMsg(PQresultErrorMessage(res));
+        PQclear(res);
+        throw AnnotatedException(400, "Could not describe PostgreSQL query: "
+                                 + errorMsg);
+    }
+
+    std::vector<std::pair<string, Oid> > result;
+    for (int j = 0;  j < PQnfields(res);  ++j)
+        result.emplace_back(PQfname(res, j), PQftype(res, j));
+    PQclear(res);
+    return result;
+}
+
+
+/** Return the literal for a constant in a PostgreSQL query, or false if
+    it can't be written as one.  It's left untyped, so that PostgreSQL
+    converts it to the type of what it's compared with.
+*/
+bool getPostgresqlLiteral(const CellValue & val, string & result)
+{
+    if (val.empty()) {
+        result = "NULL";
+        return true;
+    }
+    if (!val.isString() && !(val.isNumber() && !val.isNaN() && !val.isInf()))
+        return false;
+
+    result = "E'";
+    for (char c: val.toUtf8String().rawString()) {
+        if (c == 0)
+            return false;
+        if (c == '\'' || c == '\\')
+            result += c;
+        result += c;
+    }
+    result += '\'';
+    return true;
 }
 
+
+/*****************************************************************************/
+/* POSTGRESQL WHERE                                                          */
+/*****************************************************************************/
+
+/** Translates MLDB where clauses into PostgreSQL conditions, so that they
+    can be run by the database.  Comparisons, IN, BETWEEN, LIKE, IS NULL
+    and boolean operators over the columns of the table, constants and
+    rowName() are translated; they then have PostgreSQL's semantics, for
+    example in how a constant is converted to the type of a column.
+*/
+struct PostgresqlWhere {
+    PostgresqlWhere(const Utf8String & alias, const string & primaryKey)
+        : alias(alias), primaryKey(primaryKey)
+    {
+    }
+
+    Utf8String alias;
+    string primaryKey;
+
+    /// Return the name of the table column read by expr, or an empty string
+    string getColumn(const SqlExpression & expr) const
+    {
+        auto read = dynamic_cast<const ReadColumnExpression *>(&expr);
+        if (!read)
+            return string();
+        ColumnPath columnName = removeTableName(alias, read->columnName);
+        if (columnName.size() != 1)
+            return string();
+        return columnName[0].toUtf8String().rawString();
+    }
+
+    /// Return the SQL for a value, or an empty string if it can't be
+    /// translated
+    string translateValue(const SqlExpression & expr) const
+    {
+        string column = getColumn(expr);
+        if (!column.empty())
+            return quotePostgresqlIdentifier(column);
+
+        if (auto constant = dynamic_cast<const ConstantExpression *>(&expr)) {
+            string result;
+            if (constant->constant.isAtom()
+                && getPostgresqlLiteral(constant->constant.getAtom(), result))
+                return result;
+            return string();
+        }
+
+        auto function = dynamic_cast<const FunctionCallExpression *>(&expr);
+        if (function && function->functionName == "rowName"
+            && function->args.empty())
+            return primaryKey;
+
+        return string();
+    }
+
+    /// Return the SQL for a condition, or an empty string if it can't be
+    /// translated
+    string translate(const SqlExpression & expr) const
+    {
+        if (auto boolean
+            = dynamic_cast<const BooleanOperatorExpression *>(&expr)) {
+            string r = translate(*boolean->rhs);
+            if (r.empty())
+                return string();
+            if (boolean->op == "NOT" && !boolean->lhs)
+                return "(NOT " + r + ")";
+            if (!boolean->lhs
+                || (boolean->op != "AND" && boolean->op != "OR"))
+                return string();
+            string l = translate(*boolean->lhs);
+            if (l.empty())
+                return string();
+            return "(" + l + " " + boolean->op + " " + r + ")";
+        }
+
+        if (auto constant = dynamic_cast<const ConstantExpression *>(&expr)) {
+            const ExpressionValue & val = constant->constant;
+            if (val.empty())
+                return "NULL";
+            if (val.isAtom() && val.getAtom().isNumber())
+                return val.isTrue() ? "TRUE" : "FALSE";
+            return string();
+        }
+
+        if (auto comparison
+            = dynamic_cast<const ComparisonExpression *>(&expr)) {
+            string l = translateValue(*comparison->lhs);
+            string r = translateValue(*comparison->rhs);
+            if (l.empty() || r.empty())
+                return string();
+            string op = comparison->op;
+            if (op == "==")
+                op = "=";
+            else if (op == "!=")
+                op = "<>";
+            return "(" + l + " " + op + " " + r + ")";
+        }
+
+        if (auto isType = dynamic_cast<const IsTypeExpression *>(&expr)) {
+            string v = translateValue(*isType->expr);
+            if (isType->type != "null" || v.empty())
+                return string();
+            return "(" + v + (isType->notType ? " IS NOT NULL)" : " IS NULL)");
+        }
+
+        if (auto in = dynamic_cast<const InExpression *>(&expr)) {
+            if (in->kind != InExpression::TUPLE || in->tuple->clauses.empty())
+                return string();
+            string v = translateValue(*in->expr);
+            if (v.empty())
+                return string();
+            string values;
+            for (auto & c: in->tuple->clauses) {
+                string value = translateValue(*c);
+                if (value.empty())
+                    return string();
+                if (!values.empty())
+                    values += ", ";
+                values += value;
+            }
+            return "(" + v + (in->isNegative ? " NOT IN (" : " IN (")
+                + values + "))";
+        }
+
+        if (auto between = dynamic_cast<const BetweenExpression *>(&expr)) {
+            string v = translateValue(*between->expr);
+            string l = translateValue(*between->lower);
+            string u = translateValue(*between->upper);
+            if (v.empty() || l.empty() || u.empty())
+                return string();
+            return "(" + v + (between->notBetween ? " NOT BETWEEN " : " BETWEEN ")
+                + l + " AND " + u + ")";
+        }
+
+        if (auto like = dynamic_cast<const LikeExpression *>(&expr)) {
+            string l = translateValue(*like->left);
+            string r = translateValue(*like->right);
+            if (l.empty() || r.empty())
+                return string();
+            return "(" + l + (like->isNegative ? " NOT LIKE " : " LIKE ")
+                + r + ")";
+        }
+
+        return string();
+    }
+};
+
+/// Add the conjuncts of expr (the clauses of a chain of ANDs) to conjuncts
+void getConjuncts(const std::shared_ptr<SqlExpression> & expr,
+                  std::vector<std::shared_ptr<SqlExpression> > & conjuncts)
+{
+    auto boolean = dynamic_cast<const BooleanOperatorExpression *>(expr.get());
+    if (boolean && boolean->op == "AND" && boolean->lhs) {
+        getConjuncts(boolean->lhs, conjuncts);
+        getConjuncts(boolean->rhs, conjuncts);
+    }
+    else conjuncts.push_back(expr);
+}
+
+
+/*****************************************************************************/
+/* POSTGRESQL COPY READER                                                    */
+/*****************************************************************************/
+
+/** Reads the output of a COPY ... TO STDOUT (FORMAT binary) statement one
+    row at a time as it arrives from the server, so that the result never
+    has to be held in memory as a whole.
+*/
+struct PostgresqlCopyReader {
+    PostgresqlCopyReader(pg_conn * conn, const string & copyStatement,
+                         size_t numColumns)
+        : conn(conn), numColumns(numColumns)
+    {
+        auto res = PQexec(conn, copyStatement.c_str());
+        if (PQresultStatus(res) != PGRES_COPY_OUT) {
+            string errorMsg(PQresultErrorMessage(res));
+            PQclear(res);
+            throw AnnotatedException(400, "Could not query PostgreSQL "
+                                     "database: " + errorMsg);
+        }
+        PQclear(res);
+    }
+
+    ~PostgresqlCopyReader()
+    {
+        if (buffer)
+            PQfreemem(buffer);
+    }
+
+    /** Point fields at the data and length of each field of the next row,
+        with a negative length for NULL; they are valid until the next call.
+        Returns false once all of the rows have been read.
+    */
+    bool next(std::vector<std::pair<const char *, int32_t> > & fields)
+    {
+        while (current == end) {
+            if (buffer) {
+                PQfreemem(buffer);
+                buffer = nullptr;
+            }
+            if (finished)
+                return false;
+
+            int len = PQgetCopyData(conn, &buffer, 0 /* wait for data */);
+            if (len == -1) {
+                finish();
+                return false;
+            }
+            if (len < 0) {
+                throw AnnotatedException(400, "Error reading from PostgreSQL: "
+                                         + string(PQerrorMessage(conn)));
+            }
+            current = buffer;
+            end = buffer + len;
+
+            if (!readHeader) {
+                static const char signature[] = "PGCOPY\n\377\r\n";
+                if (len < 19 || std::memcmp(current, signature, 11) != 0)
+                    throw AnnotatedException(500, "Invalid binary COPY header "
+                                             "from PostgreSQL");
+                current += 15;  // signature and flags
+                current += 4 + readInt32();  // header extension
+                readHeader = true;
+            }
+        }
+
+        int16_t numFields = readInt16();
+        if (numFields == -1) {
+            // Trailer; nothing follows
+            current = end;
+            finished = true;
+            return next(fields);
+        }
+        if ((size_t)numFields != numColumns)
+            throw AnnotatedException(500, "Unexpected number of fields in "
+                                     "PostgreSQL COPY row",
+                                     "expected", numColumns,
+                                     "got", numFields);
+
+        fields.resize(numColumns);
+        for (auto & f: fields) {
+            int32_t len = readInt32();
+            f.first = current;
+            f.second = len;
+            if (len > 0)
+                skip(len);
+        }
+        return true;
+    }
+
+private:
+    void skip(size_t n)
+    {
+        if (end - current < (ssize_t)n)
+            throw AnnotatedException(500, "Truncated PostgreSQL COPY row");
+        current += n;
+    }
+
+    int16_t readInt16()
+    {
+        uint16_t val;
+        const char * p = current;
+        skip(sizeof(val));
+        std::memcpy(&val, p, sizeof(val));
+        return be16toh(val);
+    }
+
+    int32_t readInt32()
+    {
+        uint32_t val;
+        const char * p = current;
+        skip(sizeof(val));
+        std::memcpy(&val, p, sizeof(val));
+        return be32toh(val);
+    }
+
+    void finish()
+    {
+        finished = true;
+        PGresult * res;
+        string errorMsg;
+        while ((res = PQgetResult(conn))) {
+            if (PQresultStatus(res) != PGRES_COMMAND_OK)
+                errorMsg = PQresultErrorMessage(res);
+            PQclear(res);
+        }
+        if (!errorMsg.empty())
+            throw AnnotatedException(400, "Could not query PostgreSQL "
+                                     "database: " + errorMsg);
+    }
+
+    pg_conn * conn;
+    size_t numColumns;
+    char * buffer = nullptr;
+    const char * current = nullptr;
+    const char * end = nullptr;
+    bool readHeader = false;
+    bool finished = false;
+};
+
+/** Append a value to a COPY ... FROM STDIN statement's data in text
+    format.
+*/
+void appendPostgresqlCopyValue(string & out, const CellValue & val)
+{
+    if (val.empty()) {
+        out += "\\N";
+        return;
+    }
+
+    for (char c: val.toUtf8String().rawString()) {
+        switch (c) {
+        case '\\': out += "\\\\";  break;
+        case '\t': out += "\\t";  break;
+        case '\n': out += "\\n";  break;
+        case '\r': out += "\\r";  break;
+        default:   out += c;
+        }
+    }
+}
+
+} // file scope
+
 /*****************************************************************************/
 /* POSTGRESQL DATASET                                                        */
 /*****************************************************************************/
@@ -183,97 +667,132 @@ struct PostgresqlDataset: public Dataset {
         throw AnnotatedException(400, "PostgreSQL dataset is read-only");
     }
 
-    virtual GenerateRowsWhereFunction
-    generateRowsWhere(const SqlBindingScope & context,
-                      const Utf8String& alias,
-                      const SqlExpression & where,
-                      ssize_t offset,
-                      ssize_t limit) const override
+    /** Return the keys of the rows that a query returns, which are
+        received one row at a time, rather than the server building up the
+        whole result in memory first.
+    */
+    std::vector<RowPath> selectKeys(const string & selectString) const
     {
-
-        auto conn = startConnection();
-        string selectString = "SELECT ";
-        selectString += config_.primaryKey + 
-                        " FROM " + 
-                        config_.tableName +
-                        " WHERE " + 
-                        where.surface.rawString();
-
         POSTGRESQL_VERBOSE(cerr << "postgress where select: " << endl);
         POSTGRESQL_VERBOSE(cerr << selectString << endl);
 
-        auto res = PQexec(conn, selectString.c_str());
-        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-            string errorMsg(PQresultErrorMessage(res));
-            PQclear(res);
-            PQfinish(conn);
+        auto conn = startConnection();
+        Scope_Exit(PQfinish(conn));
+
+        if (!PQsendQuery(conn, selectString.c_str())
+            || !PQsetSingleRowMode(conn)) {
+            string errorMsg(PQerrorMessage(conn));
             throw AnnotatedException(400, "Could not select from postgreSQL: ", errorMsg);
         }
-        
-        POSTGRESQL_VERBOSE(cerr << "keys fetched from " << config_.tableName << " sucessfully!" << endl;)
 
         std::vector<RowPath> rowsToKeep;
-
-        int nfields = PQnfields(res);
-        int ntuples = PQntuples(res);
-
-        POSTGRESQL_VERBOSE(cerr << ntuples << "," << nfields << endl;)
-
-        if (nfields == 1) {
-            for(int i = 0; i < ntuples; i++) {
-                rowsToKeep.emplace_back(PQgetvalue(res, i, 0));        
+        string errorMsg;
+
+        PGresult * res;
+        while ((res = PQgetResult(conn))) {
+            auto status = PQresultStatus(res);
+            if (status == PGRES_SINGLE_TUPLE) {
+                if (PQnfields(res) == 1)
+                    rowsToKeep.emplace_back(PQgetvalue(res, 0, 0));
+            }
+            else if (status != PGRES_TUPLES_OK) {
+                errorMsg = PQresultErrorMessage(res);
             }
+            PQclear(res);
         }
 
-        PQclear(res);
-        PQfinish(conn);
+        if (!errorMsg.empty())
+            throw AnnotatedException(400, "Could not select from postgreSQL: ", errorMsg);
 
-        return {[=] (ssize_t numToGenerate, Any token,
-                     const BoundParameters & params,
-                     const ProgressFunc & onProgress)
-        {
-            ssize_t start = 0;
-            ssize_t limit = numToGenerate;
+        POSTGRESQL_VERBOSE(cerr << rowsToKeep.size() << " keys fetched from " << config_.tableName << " sucessfully!" << endl;)
 
-            ExcAssertNotEqual(limit, 0);
-            
-            if (!token.empty())
-                start = token.convert<size_t>();            
+        return rowsToKeep;
+    }
 
-            start += rowsToKeep.size();
-            Any newToken;
-            if (rowsToKeep.size() == limit)
-                newToken = start;
+    /** The parts of the where clause that can be translated are run by
+        PostgreSQL, so that only the keys of the rows that match them are
+        read.  The rest of the clause is evaluated by MLDB on those rows.
+    */
+    virtual GenerateRowsWhereFunction
+    generateRowsWhere(const SqlBindingScope & context,
+                      const Utf8String& alias,
+                      const SqlExpression & where,
+                      ssize_t offset,
+                      ssize_t limit) const override
+    {
+        PostgresqlWhere translator(alias, config_.primaryKey);
+
+        std::vector<std::shared_ptr<SqlExpression> > conjuncts;
+        getConjuncts(where.shallowCopy(), conjuncts);
+
+        string condition;
+        std::shared_ptr<SqlExpression> filter;
+        for (auto & c: conjuncts) {
+            string sql = translator.translate(*c);
+            if (sql.empty()) {
+                filter = filter
+                    ? std::make_shared<BooleanOperatorExpression>(filter, c, "AND")
+                    : c;
+            }
+            else {
+                if (!condition.empty())
+                    condition += " AND ";
+                condition += sql;
+            }
+        }
 
-            return make_pair(std::move(rowsToKeep),
-                             std::move(newToken));
-        },
-        "PostgresqlDataset row generation"};
+        string selectString = "SELECT " + config_.primaryKey
+            + " FROM " + config_.tableName;
+        if (!condition.empty())
+            selectString += " WHERE " + condition;
+
+        // The limit and offset can only be applied by PostgreSQL if it
+        // filters all of the rows
+        if (!filter) {
+            if (limit != -1)
+                selectString += " LIMIT " + to_string(limit);
+            if (offset != 0)
+                selectString += " OFFSET " + to_string(offset);
+        }
 
+        auto dataset = this;
+        GenerateRowsWhereFunction gen
+            {[=] (ssize_t numToGenerate, Any token,
+                  const BoundParameters & params,
+                  const ProgressFunc & onProgress)
+             -> std::pair<std::vector<RowPath>, Any>
+             {
+                 return { dataset->selectKeys(selectString), Any() };
+             },
+             "PostgreSQL query " + selectString,
+             condition.empty()
+             ? GenerateRowsWhereFunction::TABLESCAN
+             : GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
+
+        if (!filter)
+            return gen;
+        return generateFilteredRows(*this, alias, std::move(gen), *filter);
     }
 
-    /** Return a row as an expression value.  Default forwards to the matrix
-    view's getRow() function.
+    /** Return the given columns of the row with the given key, using
+        selectString which has the key as its parameter.
     */
-    virtual ExpressionValue getRowExpr(const RowPath & row) const override
+    ExpressionValue selectRow(const string & selectString,
+                              const RowPath & row) const
     {
-        auto conn = startConnection();
-        string selectString = "SELECT * FROM ";
-        selectString += config_.tableName +
-                        " WHERE " + 
-                        config_.primaryKey + 
-                        " = '" + 
-                        row.toUtf8String().rawString()
-                        + "'";
-
         POSTGRESQL_VERBOSE(cerr << "postgress row select: " << endl;)
         POSTGRESQL_VERBOSE(cerr << selectString << endl;)
 
-        auto res = PQexec(conn, selectString.c_str());
+        auto conn = startConnection();
+        Scope_Exit(PQfinish(conn));
+
+        string key = row.toUtf8String().rawString();
+        const char * params[1] = { key.c_str() };
+        auto res = PQexecParams(conn, selectString.c_str(), 1, nullptr,
+                                params, nullptr, nullptr, 0);
+        Scope_Exit(PQclear(res));
         if (PQresultStatus(res) != PGRES_TUPLES_OK) {
             string errorMsg(PQresultErrorMessage(res));
-            PQclear(res);
-            PQfinish(conn);
             throw AnnotatedException(400, "Could not select from postgreSQL: ", errorMsg);
         }
 
@@ -286,18 +805,190 @@ struct PostgresqlDataset: public Dataset {
 
         std::vector<std::tuple<ColumnPath, CellValue, Date> > rowValues;
         if (ntuples > 0) {
-            std::vector<std::tuple<ColumnPath, CellValue, Date> > cols;
             for(int j = 0; j < nfields; j++) {
                 rowValues.emplace_back(ColumnPath(PQfname(res, j)), getCellValueFromPostgres(res, 0, j), Date::Date::notADate());
                 POSTGRESQL_VERBOSE(printf("[%d,%d] %s %s\n", 0, j, PQgetvalue(res, 0, j), PQfname(res, j));)
-            }       
+            }
         }
 
-        PQclear(res);
-        PQfinish(conn);
-
         return ExpressionValue(rowValues);
+    }
+
+    /** Return a row as an expression value.  Default forwards to the matrix
+    view's getRow() function.
+    */
+    virtual ExpressionValue getRowExpr(const RowPath & row) const override
+    {
+        return selectRow("SELECT * FROM " + config_.tableName + " WHERE "
+                         + config_.primaryKey + " = $1", row);
+    }
+
+    /// Return the names and types of the columns of the table
+    std::vector<std::pair<string, Oid> > getTableColumns() const
+    {
+        auto conn = startConnection();
+        Scope_Exit(PQfinish(conn));
+        return describePostgresqlQuery(conn, "SELECT * FROM " + config_.tableName);
+    }
+
+    /** Only select the columns of the table that the expression reads,
+        when they can be worked out.
+    */
+    virtual std::function<ExpressionValue (const RowPath & row)>
+    getRowExprProjection(const UnboundEntities & unbound,
+                         const Utf8String & alias) const override
+    {
+        bool projectable = unbound.wildcards.empty()
+            && !unbound.funcs.count("columnCount");
+
+        // Variables scoped by a table name are only there in joins and
+        // sub-selects, where we don't try to work it out.
+        for (auto & t: unbound.tables) {
+            if (!t.second.vars.empty() || !t.second.wildcards.empty()
+                || t.second.funcs.count(PathElement("columnCount")))
+                projectable = false;
+        }
+
+        std::set<string> read;
+        for (auto & v: unbound.vars) {
+            ColumnPath columnName = removeTableName(alias, v.first);
+            if (columnName.empty())
+                projectable = false;
+            else read.insert(columnName[0].toUtf8String().rawString());
+        }
+
+        if (!projectable)
+            return Dataset::getRowExprProjection(unbound, alias);
+
+        string selectList;
+        for (auto & c: getTableColumns()) {
+            if (!read.count(c.first))
+                continue;
+            if (!selectList.empty())
+                selectList += ", ";
+            selectList += quotePostgresqlIdentifier(c.first);
+        }
 
+        if (selectList.empty()) {
+            return [] (const RowPath & row)
+                {
+                    return ExpressionValue
+                        (std::vector<std::tuple<ColumnPath, CellValue, Date> >());
+                };
+        }
+
+        string selectString = "SELECT " + selectList + " FROM "
+            + config_.tableName + " WHERE " + config_.primaryKey + " = $1";
+        return [=] (const RowPath & row)
+            {
+                return this->selectRow(selectString, row);
+            };
+    }
+
+    /** Calculate count() and, over integer columns, min() and max() with
+        a query of the table, when all of the where clause can be run by
+        PostgreSQL.  The values of the rows have no timestamp, so neither
+        do the results.
+    */
+    virtual bool
+    pushdownAggregators(const Utf8String & alias,
+                        const SqlExpression & where,
+                        const std::vector<std::shared_ptr<SqlExpression> > & aggregators,
+                        std::vector<ExpressionValue> & results,
+                        uint64_t & numRows) const override
+    {
+        PostgresqlWhere translator(alias, config_.primaryKey);
+        string condition = translator.translate(where);
+        if (condition.empty())
+            return false;
+
+        auto columns = getTableColumns();
+        auto getColumnType = [&] (const string & name) -> int
+            {
+                for (auto & c: columns) {
+                    if (c.first == name)
+                        return c.second;
+                }
+                return -1;
+            };
+
+        // Each aggregator is either a count of the rows (-1), or the
+        // given column of the result
+        string selectList = "count(*)";
+        int numFields = 1;
+        std::vector<int> fields;
+        std::vector<Date> tss;
+        for (auto & a: aggregators) {
+            auto function = dynamic_cast<const FunctionCallExpression *>(a.get());
+            if (!function || function->args.size() != 1)
+                return false;
+            const string & name = function->functionName.rawString();
+
+            auto constant = dynamic_cast<const ConstantExpression *>
+                (function->args[0].get());
+            if (name == "count" && constant && !constant->constant.empty()) {
+                fields.push_back(-1);
+                tss.push_back(constant->constant.getEffectiveTimestamp());
+                continue;
+            }
+
+            string column = translator.getColumn(*function->args[0]);
+            int type = getColumnType(column);
+            if (column.empty() || type == -1)
+                return false;
+            if (name == "count") {
+                // The count of values without a timestamp has none
+                tss.push_back(Date::negativeInfinity());
+            }
+            else if ((name == "min" || name == "max") && type == PG_INT4) {
+                tss.push_back(Date::notADate());
+            }
+            else return false;
+
+            fields.push_back(numFields++);
+            selectList += ", " + name + "(" + quotePostgresqlIdentifier(column) + ")";
+        }
+
+        string selectString = "SELECT " + selectList + " FROM "
+            + config_.tableName + " WHERE " + condition;
+
+        POSTGRESQL_VERBOSE(cerr << "postgress aggregate select: " << endl;)
+        POSTGRESQL_VERBOSE(cerr << selectString << endl;)
+
+        auto conn = startConnection();
+        Scope_Exit(PQfinish(conn));
+
+        auto res = PQexec(conn, selectString.c_str());
+        Scope_Exit(PQclear(res));
+        if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) != 1) {
+            string errorMsg(PQresultErrorMessage(res));
+            throw AnnotatedException(400, "Could not select from postgreSQL: ", errorMsg);
+        }
+
+        numRows = std::stoull(PQgetvalue(res, 0, 0));
+
+        results.clear();
+        for (size_t i = 0;  i < aggregators.size();  ++i) {
+            int field = fields[i];
+            if (field == -1) {
+                results.emplace_back(numRows,
+                                     numRows ? tss[i] : Date::negativeInfinity());
+            }
+            else if (PQgetisnull(res, 0, field)) {
+                results.emplace_back(CellValue(), Date::negativeInfinity());
+            }
+            else if (PQftype(res, field) == PG_INT8) {
+                // count()
+                results.emplace_back(std::stoull(PQgetvalue(res, 0, field)),
+                                     tss[i]);
+            }
+            else {
+                results.emplace_back(getCellValueFromPostgres(res, 0, field),
+                                     tss[i]);
+            }
+        }
+
+        return true;
     }
 
     /** Return whether or not all columns names and info are known.
@@ -345,6 +1036,7 @@ PostgresqlRecorderDatasetConfigDescription()
 struct PostgresqlRecorderDataset: public Dataset {
 
     PostgresqlRecorderDatasetConfig config_;
+    std::mutex columnsMutex;  ///< Protects insertedColumns
     std::unordered_set<ColumnPath> insertedColumns;
 
     pg_conn* startConnection() 
@@ -457,72 +1149,194 @@ struct PostgresqlRecorderDataset: public Dataset {
         }
     }
 
-    void insertRowPostgresql(pg_conn* conn, const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals) 
+    /** Record the rows with a single COPY ... FROM STDIN statement, which
+        is much faster than inserting them one by one.  Columns that a row
+        doesn't have are recorded as NULL.
+    */
+    void copyRowsPostgresql(pg_conn* conn, const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > & rows)
     {
-        alterColumns(conn, vals);
-
-        string insertString = "INSERT INTO " + config_.tableName + " (";
-
-        bool first = true;
-        for (auto& p : vals) {                
-            if (!first) {
-                insertString += ",";                    
+        std::vector<ColumnPath> columns;
+        std::unordered_map<ColumnPath, int> columnIndex;
+        {
+            std::unique_lock<std::mutex> guard(columnsMutex);
+            for (auto & r: rows) {
+                alterColumns(conn, r.second);
+                for (auto & p: r.second) {
+                    if (columnIndex.emplace(std::get<0>(p), columns.size()).second)
+                        columns.push_back(std::get<0>(p));
+                }
             }
-            first = false;
-            insertString += std::get<0>(p).toUtf8String().rawString();
         }
 
-        insertString += ") VALUES (";
+        if (columns.empty())
+            return;
 
-        first = true;
-        for (auto& p : vals) {                
-            if (!first) {
-                insertString += ",";                    
-            }
-            first = false;
-            auto& cell = std::get<1>(p);
-            if (cell.isString())
-                insertString += "'" + cell.toString() + "'";
-            else
-                insertString += cell.toString();
+        string copyString = "COPY " + config_.tableName + " (";
+        for (size_t i = 0;  i < columns.size();  ++i) {
+            if (i != 0)
+                copyString += ",";
+            copyString += columns[i].toUtf8String().rawString();
         }
+        copyString += ") FROM STDIN";
 
-        insertString += ")";
+        POSTGRESQL_VERBOSE(cerr << copyString << endl;)
 
-        POSTGRESQL_VERBOSE(cerr << insertString << endl;)
+        auto error = [&] (const string & errorMsg)
+            {
+                PQfinish(conn);
+                throw AnnotatedException(400, "Could not insert data in PostgreSQL table:  ", errorMsg);
+            };
 
-        auto res = PQexec(conn, insertString.c_str());
-        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        auto res = PQexec(conn, copyString.c_str());
+        if (PQresultStatus(res) != PGRES_COPY_IN) {
             string errorMsg(PQresultErrorMessage(res));
             PQclear(res);
-            PQfinish(conn);
-            throw AnnotatedException(400, "Could not insert data in PostgreSQL table:  ", errorMsg);
+            error(errorMsg);
         }
-
         PQclear(res);
+
+        // Send the data in pieces, so that it doesn't all have to be
+        // formatted at once
+        string data;
+        std::vector<const CellValue *> values(columns.size());
+        for (auto & r: rows) {
+            std::fill(values.begin(), values.end(), nullptr);
+            for (auto & p: r.second)
+                values[columnIndex[std::get<0>(p)]] = &std::get<1>(p);
+            for (size_t i = 0;  i < values.size();  ++i) {
+                if (i != 0)
+                    data += '\t';
+                appendPostgresqlCopyValue(data, values[i] ? *values[i] : CellValue());
+            }
+            data += '\n';
+
+            if (data.size() >= 65536 || &r == &rows.back()) {
+                if (PQputCopyData(conn, data.data(), data.size()) != 1)
+                    error(PQerrorMessage(conn));
+                data.clear();
+            }
+        }
+
+        if (PQputCopyEnd(conn, nullptr) != 1)
+            error(PQerrorMessage(conn));
+
+        string errorMsg;
+        while ((res = PQgetResult(conn))) {
+            if (PQresultStatus(res) != PGRES_COMMAND_OK)
+                errorMsg = PQresultErrorMessage(res);
+            PQclear(res);
+        }
+        if (!errorMsg.empty())
+            error(errorMsg);
     }
 
     virtual void recordRowItl(const RowPath & rowName,
                               const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals) override
     {
-        auto conn = startConnection();
-
-        insertRowPostgresql(conn, vals);
-
-        PQfinish(conn);
+        recordRows({ { rowName, vals } });
     }
     
     virtual void recordRows(const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > & rows) override
     {
         auto conn = startConnection();
 
-        for (auto& vals : rows) {
-            insertRowPostgresql(conn, vals.second);
-        }        
+        copyRowsPostgresql(conn, rows);
 
         PQfinish(conn);
     }
 
+    /** Recorder for one chunk, that accumulates rows and copies them into
+        the table in batches over its own connection.
+    */
+    struct ChunkRecorder: public Recorder {
+        ChunkRecorder(PostgresqlRecorderDataset * dataset)
+            : Recorder(dataset->engine), dataset(dataset)
+        {
+        }
+
+        ~ChunkRecorder()
+        {
+            if (conn)
+                PQfinish(conn);
+        }
+
+        /// Rows accumulated before they are sent to the database
+        static constexpr size_t rowsPerBatch = 10000;
+
+        PostgresqlRecorderDataset * dataset;
+        pg_conn * conn = nullptr;
+        std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > rows;
+
+        virtual void
+        recordRowExpr(const RowPath & rowName,
+                      const ExpressionValue & expr) override
+        {
+            RowValue row;
+            expr.appendToRow(ColumnPath(), row);
+            recordRowDestructive(rowName, std::move(row));
+        }
+
+        virtual void
+        recordRow(const RowPath & rowName,
+                  const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals) override
+        {
+            recordRowDestructive(rowName, vals);
+        }
+
+        virtual void
+        recordRowDestructive(RowPath rowName,
+                             std::vector<std::tuple<ColumnPath, CellValue, Date> > vals) override
+        {
+            rows.emplace_back(std::move(rowName), std::move(vals));
+            if (rows.size() >= rowsPerBatch)
+                flush();
+        }
+
+        virtual void
+        recordRows(const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > & rows) override
+        {
+            for (auto & r: rows)
+                recordRow(r.first, r.second);
+        }
+
+        virtual void
+        recordRowsExpr(const std::vector<std::pair<RowPath, ExpressionValue > > & rows) override
+        {
+            for (auto & r: rows)
+                recordRowExpr(r.first, r.second);
+        }
+
+        virtual void finishedChunk() override
+        {
+            flush();
+        }
+
+        void flush()
+        {
+            if (rows.empty())
+                return;
+            if (!conn)
+                conn = dataset->startConnection();
+            pg_conn * c = conn;
+            conn = nullptr;  // closed by copyRowsPostgresql on error
+            dataset->copyRowsPostgresql(c, rows);
+            conn = c;
+            rows.clear();
+        }
+    };
+
+    virtual MultiChunkRecorder getChunkRecorder() override
+    {
+        MultiChunkRecorder result;
+        result.newChunk = [=] (size_t)
+            {
+                return std::unique_ptr<Recorder>(new ChunkRecorder(this));
+            };
+
+        result.commit = [=] () { this->commit(); };
+        return result;
+    }
+
     /** Commit changes to the database.  Default is a no-op. */
     virtual void commit() override
     {
@@ -568,6 +1382,8 @@ struct PostgresqlImportConfig: public ProcedureConfig {
     int port;
     string host;
     string postgresqlQuery;
+    string partitionKey;
+    int numPartitions;
 
     /// The output dataset.  Rows will be dumped into here via insertRows.
     PolyConfigT<Dataset> outputDataset;
@@ -577,6 +1393,7 @@ struct PostgresqlImportConfig: public ProcedureConfig {
         port = postgresqlDefaultPort;
         host = "localhost";
         postgresqlQuery = "";
+        numPartitions = -1;
 
         outputDataset.withType("sparse.mutable");
     }
@@ -593,6 +1410,14 @@ PostgresqlImportConfigDescription()
     addField("port", &PostgresqlImportConfig::port, "Port of the database to connect to.", postgresqlDefaultPort);
     addField("host", &PostgresqlImportConfig::host, "Address of the database to connect to ");
     addField("postgresqlQuery", &PostgresqlImportConfig::postgresqlQuery, "Query to run in postgresql to get rows");
+    addField("partitionKey", &PostgresqlImportConfig::partitionKey,
+             "Integer valued column of the query's output used to split it "
+             "into ranges that are read in parallel, each over its own "
+             "connection.  If empty, the query is read over a single "
+             "connection.");
+    addField("numPartitions", &PostgresqlImportConfig::numPartitions,
+             "Number of ranges of `partitionKey` to read in parallel.  The "
+             "default of -1 uses one per CPU.", -1);
 
     addField("outputDataset", &PostgresqlImportConfig::outputDataset,
              "Output dataset configuration.  This may refer either to an "
@@ -609,7 +1434,7 @@ struct PostgresqlImportProcedure: public Procedure {
     PostgresqlImportProcedure(MldbEngine * engine,
                          const PolyConfig & config,
                          std::function<bool (Json::Value)> onProgress)
-        : Procedure(server)
+        : Procedure(engine)
     {
         procedureConfig = config.params.convert<PostgresqlImportConfig>();
     }
@@ -629,48 +1454,158 @@ struct PostgresqlImportProcedure: public Procedure {
     virtual RunOutput run(const ProcedureRunConfig & run,
                           const std::function<bool (const Json::Value &)> & onProgress) const override
     {        
-        RunOutput result;
-
         auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
 
         // Connect to Postgresl database
         auto conn = startConnection(runProcConf);
 
+        std::vector<std::pair<string, Oid> > columns;
+        std::vector<string> partitions;
+        try {
+            columns = describePostgresqlQuery(conn, runProcConf.postgresqlQuery);
+            partitions = getPartitions(conn, runProcConf);
+        } catch (...) {
+            PQfinish(conn);
+            throw;
+        }
+        PQfinish(conn);
+
+        // Types without a useful binary form are converted to text by
+        // the server
+        string selectList;
+        std::vector<ColumnPath> columnPaths;
+        for (auto & c: columns) {
+            if (!selectList.empty())
+                selectList += ",";
+            selectList += quotePostgresqlIdentifier(c.first);
+            if (!isPostgresqlBinaryType(c.second))
+                selectList += "::text";
+            columnPaths.emplace_back(c.first);
+        }
+
         // Create the output
         std::shared_ptr<Dataset> output =
-        createDataset(server, runProcConf.outputDataset, nullptr, true ); //overwrite
+        createDataset(engine, runProcConf.outputDataset, nullptr, true ); //overwrite
 
-        //query the rows
-        auto res = PQexec(conn, runProcConf.postgresqlQuery.c_str());
-        if (PQresultStatus(res) != PGRES_TUPLES_OK)
-        {
-            string errorMsg = PQresultErrorMessage(res);
-            PQclear(res);
-            PQfinish(conn);
-            throw AnnotatedException(400, "Could not query PostgreSQL database", errorMsg);
-        }
+        auto recorder = output->getChunkRecorder();
+        std::atomic<size_t> chunkNumber(0);
 
-        int nfields = PQnfields(res);
-        int ntuples = PQntuples(res);
+        // Each partition is streamed with a binary COPY over its own
+        // connection and recorded into chunks of rowsPerChunk rows
+        static constexpr size_t rowsPerChunk = 65536;
 
-        std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > rows;
-        for(int i = 0; i < ntuples; i++) {
-            std::vector<std::tuple<ColumnPath, CellValue, Date> > cols;
-            for(int j = 0; j < nfields; j++) {
-                cols.emplace_back(ColumnPath(PQfname(res, j)), getCellValueFromPostgres(res, i, j), Date::Date::notADate());
-            }
-            rows.emplace_back(Path(string("row_" + std::to_string(i))), std::move(cols));            
-        }
+        auto readPartition = [&] (size_t p)
+            {
+                string copyStatement
+                    = "COPY (SELECT " + selectList + " FROM ("
+                    + runProcConf.postgresqlQuery + ") AS mldb_query"
+                    + partitions[p] + ") TO STDOUT (FORMAT binary)";
+
+                POSTGRESQL_VERBOSE(cerr << copyStatement << endl;)
+
+                auto conn = startConnection(runProcConf);
+                Scope_Exit(PQfinish(conn));
+
+                PostgresqlCopyReader reader(conn, copyStatement, columns.size());
+
+                std::unique_ptr<Recorder> chunk;
+                size_t rowsInChunk = 0;
+                std::vector<std::pair<const char *, int32_t> > fields;
+
+                for (size_t i = 0;  reader.next(fields);  ++i) {
+                    std::vector<std::tuple<ColumnPath, CellValue, Date> > cols;
+                    for (size_t j = 0;  j < fields.size();  ++j) {
+                        if (fields[j].second < 0)
+                            continue;  // NULL
+                        cols.emplace_back(columnPaths[j],
+                                          getCellValueFromPostgresBinary
+                                              (columns[j].second,
+                                               fields[j].first,
+                                               fields[j].second),
+                                          Date::notADate());
+                    }
+
+                    string rowName = partitions.size() == 1
+                        ? "row_" + std::to_string(i)
+                        : "row_" + std::to_string(p) + "_" + std::to_string(i);
+
+                    if (!chunk) {
+                        chunk = recorder.newChunk(chunkNumber.fetch_add(1));
+                        rowsInChunk = 0;
+                    }
+                    chunk->recordRowDestructive(Path(rowName), std::move(cols));
+                    if (++rowsInChunk == rowsPerChunk) {
+                        chunk->finishedChunk();
+                        chunk.reset();
+                    }
+                }
 
-        output->recordRows(rows);
+                if (chunk)
+                    chunk->finishedChunk();
+            };
+
+        parallelMap(0, partitions.size(), readPartition);
 
         // Save the dataset we created
-        output->commit();
+        recorder.commit();
 
-        result = output->getStatus();
+        return output->getStatus();
+    }
 
+    /** Return the WHERE clause that selects each of the partitions to be
+        read in parallel, splitting the range of the partition key into
+        equal parts.  Without a partition key there is a single partition
+        with no WHERE clause.
+    */
+    static std::vector<string>
+    getPartitions(pg_conn * conn, const PostgresqlImportConfig & config)
+    {
+        if (config.partitionKey.empty())
+            return { "" };
+
+        string key = quotePostgresqlIdentifier(config.partitionKey);
+        string rangeString = "SELECT min(" + key + ")::int8, max("
+            + key + ")::int8 FROM (" + config.postgresqlQuery
+            + ") AS mldb_query";
+
+        POSTGRESQL_VERBOSE(cerr << rangeString << endl;)
+
+        auto res = PQexec(conn, rangeString.c_str());
+        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+            string errorMsg(PQresultErrorMessage(res));
+            PQclear(res);
+            throw AnnotatedException(400, "Could not get the range of the "
+                                     "PostgreSQL partition key: " + errorMsg);
+        }
+
+        // Only nulls (or no rows) means there's nothing to split
+        if (PQgetisnull(res, 0, 0)) {
+            PQclear(res);
+            return { "" };
+        }
+
+        int64_t minKey = strtoll(PQgetvalue(res, 0, 0), nullptr, 10);
+        int64_t maxKey = strtoll(PQgetvalue(res, 0, 1), nullptr, 10);
         PQclear(res);
-        PQfinish(conn);
+
+        uint64_t numPartitions = config.numPartitions > 0
+            ? config.numPartitions : numCpus();
+        uint64_t width = ((uint64_t)maxKey - (uint64_t)minKey) / numPartitions + 1;
+
+        std::vector<string> result;
+        for (uint64_t p = 0;  p < numPartitions;  ++p) {
+            uint64_t offset = p * width;
+            if (offset > (uint64_t)maxKey - (uint64_t)minKey)
+                break;
+            int64_t low = minKey + offset;
+            string where = " WHERE (" + key + " >= " + std::to_string(low);
+            if ((uint64_t)maxKey - (uint64_t)low >= width)
+                where += " AND " + key + " < " + std::to_string(low + (int64_t)width);
+            where += ")";
+            if (p == 0)
+                where += " OR " + key + " IS NULL";
+            result.push_back(where);
+        }
         return result;
     }
 };
@@ -13,8 +13,14 @@
 #include "mldb/engine/bound_queries.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/date.h"
+#include "mldb/types/annotated_exception.h"
 #include "mldb/plugins/pro/pro_plugin.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 
@@ -23,7 +29,8 @@ using namespace std;
 namespace MLDB {
 
 ListFilesProcedureConfig::
-ListFilesProcedureConfig() : maxDepth(-1)
+ListFilesProcedureConfig()
+    : maxDepth(-1), numListingThreads(16), incremental(false)
 {
     outputDataset.withType("sparse.mutable");
 }
@@ -45,7 +52,27 @@ ListFilesProcedureConfigDescription()
              PolyConfigT<Dataset>().withType("tabular"));
     addField("maxDepth", &ListFilesProcedureConfig::maxDepth,
              "Maximum depth of directories to go in. -1 means unlimited.", -1);
+    addField("numListingThreads", &ListFilesProcedureConfig::numListingThreads,
+             "Number of directories (or prefixes, for S3) that are listed "
+             "at the same time.  Listing is bound by the latency of the "
+             "storage rather than by the CPU, so this can be well above the "
+             "number of cores.", 16);
+    addField("incremental", &ListFilesProcedureConfig::incremental,
+             "If true, the output dataset is kept rather than overwritten, "
+             "and only the files modified after the most recent "
+             "`last_modified` it already contains are added to it.  This "
+             "allows a large path to be listed again cheaply to pick up "
+             "new files.", false);
     addParent<ProcedureConfig>();
+
+    onPostValidate = [] (ListFilesProcedureConfig * config,
+                         JsonParsingContext & context)
+        {
+            if (config->numListingThreads < 1)
+                throw AnnotatedException
+                    (400, "numListingThreads of list.files must be at least 1",
+                     "numListingThreads", config->numListingThreads);
+        };
 }
 
 ListFilesProcedure::
@@ -57,6 +84,63 @@ ListFilesProcedure(MldbEngine * owner,
     procedureConfig = config.params.convert<ListFilesProcedureConfig>();
 }
 
+namespace {
+
+/** Work queue of the directories that remain to be listed.  Each one is
+    listed without recursion, and the subdirectories it contains are
+    pushed back onto the queue so that they can be listed by any of the
+    threads.  This shards a deep tree (or an S3 bucket, split on the
+    delimiter) into as many concurrent listings as there are threads.
+*/
+struct DirectoryQueue {
+    void push(std::string uri, int depth)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        pending.emplace_back(std::move(uri), depth);
+        cond.notify_one();
+    }
+
+    /** Return the next directory to list, or false once there are none
+        left and nothing being listed could add any more. */
+    bool pop(std::pair<std::string, int> & result)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        cond.wait(guard, [&] () { return !pending.empty() || active == 0
+                                         || stopped; });
+        if (pending.empty() || stopped)
+            return false;
+        result = std::move(pending.front());
+        pending.pop_front();
+        ++active;
+        return true;
+    }
+
+    void done()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (--active == 0 && pending.empty())
+            cond.notify_all();
+    }
+
+    void stop(std::exception_ptr exc)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (!error)
+            error = std::move(exc);
+        stopped = true;
+        cond.notify_all();
+    }
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::pair<std::string, int> > pending;
+    int active = 0;
+    std::atomic<bool> stopped { false };
+    std::exception_ptr error;
+};
+
+} // file scope
+
 RunOutput
 ListFilesProcedure::
 run(const ProcedureRunConfig & run,
@@ -66,52 +150,137 @@ run(const ProcedureRunConfig & run,
 
     SqlExpressionMldbScope context(engine);
 
-    auto output = createDataset(engine, runProcConf.outputDataset,
-                                nullptr, true /*overwrite*/);
+    std::shared_ptr<Dataset> output;
+    Date modifiedSince = runProcConf.modifiedSince;
+    bool strictlyAfter = false;
+
+    if (runProcConf.incremental) {
+        // Carry on from the newest file recorded by the previous runs
+        output = obtainDataset(engine, runProcConf.outputDataset);
+        auto index = output->getColumnIndex();
+        ColumnPath lastModified("last_modified");
+        if (index->knownColumn(lastModified)) {
+            for (auto & v: index->getColumnDistinctValues(lastModified)) {
+                if (!v.isTimestamp())
+                    continue;
+                Date d = v.toTimestamp();
+                if (d >= modifiedSince) {
+                    modifiedSince = d;
+                    strictlyAfter = true;
+                }
+            }
+        }
+    }
+    else {
+        output = createDataset(engine, runProcConf.outputDataset,
+                               nullptr, true /*overwrite*/);
+    }
+
     typedef tuple<ColumnPath, CellValue, Date> Cell;
 
     Date now = Date::now();
 
-    vector<std::pair<RowPath, vector<Cell>>> rows;
+    // Rows are recorded in batches as they are found, so that the output
+    // fills up as the listing progresses
     const int ROWS_SIZE(1024);
-    rows.reserve(ROWS_SIZE);
+    std::mutex recordMutex;
+    std::atomic<uint64_t> numFiles(0), numDirectories(0);
 
-    auto onFoundObject = [&](const std::string &uri,
-                             const FsObjectInfo &info,
-                             const OpenUriObject & open,
-                             int depth) {
-        if (info.lastModified < runProcConf.modifiedSince) {
-            return true;
-        }
+    DirectoryQueue queue;
+
+    auto listDirectory = [&] (const std::string & dirUri, int dirDepth)
+    {
+        vector<std::pair<RowPath, vector<Cell>>> rows;
+        rows.reserve(ROWS_SIZE);
 
-        vector<Cell> cells;
-        cells.emplace_back(ColumnPath("size"), info.size, now);
-        cells.emplace_back(ColumnPath("last_modified"), info.lastModified, now);
-        cells.emplace_back(ColumnPath("etag"), info.etag, now);
-        cells.emplace_back(ColumnPath("storage_class"), info.storageClass, now);
-        cells.emplace_back(ColumnPath("owner_id"), info.ownerId, now);
-        cells.emplace_back(ColumnPath("owner_name"), info.ownerName, now);
-        cells.emplace_back(ColumnPath("uri"), uri, now);
-        rows.push_back(make_pair(RowPath(uri), std::move(cells)));
-        if (rows.size() == ROWS_SIZE) {
+        auto flush = [&] ()
+        {
+            if (rows.empty())
+                return;
+            std::unique_lock<std::mutex> guard(recordMutex);
             output->recordRows(rows);
             rows.clear();
-        }
-        return true;
+        };
+
+        auto onFoundObject = [&](const std::string &uri,
+                                 const FsObjectInfo &info,
+                                 const OpenUriObject & open,
+                                 int depth) {
+            if (queue.stopped)
+                return false;
+            if (info.lastModified < modifiedSince
+                || (strictlyAfter && info.lastModified == modifiedSince)) {
+                return true;
+            }
+
+            vector<Cell> cells;
+            cells.emplace_back(ColumnPath("size"), info.size, now);
+            cells.emplace_back(ColumnPath("last_modified"), info.lastModified, now);
+            cells.emplace_back(ColumnPath("etag"), info.etag, now);
+            cells.emplace_back(ColumnPath("storage_class"), info.storageClass, now);
+            cells.emplace_back(ColumnPath("owner_id"), info.ownerId, now);
+            cells.emplace_back(ColumnPath("owner_name"), info.ownerName, now);
+            cells.emplace_back(ColumnPath("uri"), uri, now);
+            rows.push_back(make_pair(RowPath(uri), std::move(cells)));
+            ++numFiles;
+            if (rows.size() == ROWS_SIZE)
+                flush();
+            return true;
+        };
+
+        // Subdirectories aren't descended into here; each one is queued
+        // to be listed on its own.  Only those directly under the listed
+        // directory are reported, as we don't recurse.  The trailing
+        // delimiter makes an S3 listing stay within the subdirectory
+        // rather than also matching its siblings that share its prefix.
+        auto onSubDir = [&] (const std::string & dirName, int depth)
+        {
+            if (runProcConf.maxDepth == -1
+                || dirDepth + 1 <= runProcConf.maxDepth) {
+                if (!dirName.empty() && dirName.back() == '/')
+                    queue.push(dirName, dirDepth + 1);
+                else queue.push(dirName + "/", dirDepth + 1);
+            }
+            return false;
+        };
+
+        forEachUriObject(dirUri, onFoundObject, onSubDir);
+        flush();
+        ++numDirectories;
     };
 
-    auto onSubDir = [&] (const std::string & dirName, int depth)
+    queue.push(runProcConf.path.toString(), 0);
+
+    auto worker = [&] ()
     {
-        return runProcConf.maxDepth == -1 || depth <= runProcConf.maxDepth;
+        std::pair<std::string, int> dir;
+        while (queue.pop(dir)) {
+            try {
+                listDirectory(dir.first, dir.second);
+            } catch (...) {
+                queue.stop(std::current_exception());
+            }
+            queue.done();
+        }
     };
-    forEachUriObject(runProcConf.path.toString(), onFoundObject, onSubDir);
 
-    if (rows.size()) {
-        output->recordRows(rows);
-        rows.clear();
-    }
+    std::vector<std::thread> threads;
+    for (int i = 1;  i < runProcConf.numListingThreads;  ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto & t: threads)
+        t.join();
+
+    if (queue.error)
+        std::rethrow_exception(queue.error);
+
     output->commit();
-    return output->getStatus();
+
+    Json::Value status = jsonEncode(output->getStatus());
+    status["numFilesRecorded"] = (uint64_t)numFiles.load();
+    status["numDirectoriesListed"] = (uint64_t)numDirectories.load();
+    status["modifiedSince"] = jsonEncode(modifiedSince);
+    return RunOutput(status);
 }
 
 Any
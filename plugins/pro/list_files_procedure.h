@@ -20,6 +20,8 @@ struct ListFilesProcedureConfig : ProcedureConfig {
     Date modifiedSince;
     PolyConfigT<Dataset> outputDataset;
     int maxDepth;
+    int numListingThreads;
+    bool incremental;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ListFilesProcedureConfig);
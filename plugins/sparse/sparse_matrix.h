@@ -116,6 +116,13 @@ struct MatrixWriteTransaction: virtual public MatrixReadTransaction {
     virtual bool commitNeedsThread() const = 0;
     virtual void commit() = 0;
 
+    /** Will the writes be visible to new read transactions once commit()
+        returns?  If not, they are only made visible by
+        BaseMatrix::optimize(), and committing doesn't need to publish a
+        new version of the matrix.
+    */
+    virtual bool commitIsVisible() const { return true; }
+
     virtual bool isSingleReadEntry() const {return false;}
 };
 
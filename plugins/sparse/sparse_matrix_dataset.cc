@@ -18,10 +18,12 @@
 #include "mldb/base/parallel.h"
 #include "mldb/base/thread_pool.h"
 #include "mldb/utils/atomic_shared_ptr.h"
+#include "mldb/arch/rcu_protected.h"
 #include "mldb/base/parallel_merge_sort.h"
 #include "mldb/engine/dataset_utils.h"
 #include "mldb/utils/log.h"
 #include <mutex>
+#include <shared_mutex>
 
 using namespace std;
 
@@ -91,7 +93,7 @@ struct SparseMatrixDataset::Itl
     : public MatrixView, public ColumnIndex {
 
     Itl()
-        : epoch(0), timeQuantumSeconds(1.0),
+        : epoch(0), defaultTransaction(gcLock), timeQuantumSeconds(1.0),
           logger(MLDB::getMldbLog<MutableSparseMatrixDataset>())
     {
     }
@@ -119,7 +121,10 @@ struct SparseMatrixDataset::Itl
     {
     }
     
-    typedef std::mutex RootLock;
+    /// Held shared to append writes that are invisible until the next
+    /// optimize(), and exclusive for anything that publishes a new
+    /// version for readers.  Readers never take it.
+    typedef std::shared_mutex RootLock;
     mutable RootLock rootLock;
     std::atomic<int64_t> epoch;
     std::shared_ptr<BaseMatrix> metadata;
@@ -193,8 +198,15 @@ struct SparseMatrixDataset::Itl
             return std::shared_ptr<SparseRowStream>();
     }
 
-    /// Default transaction when none was passed
-    atomic_shared_ptr<ReadTransaction> defaultTransaction;
+    /// Protects readers of defaultTransaction, so that they can copy
+    /// the current version without taking a lock
+    GcLock gcLock;
+
+    /// Default transaction when none was passed.  This is the latest
+    /// committed version of the dataset; each commit that changes what
+    /// is visible publishes a new one, and the old one is freed once
+    /// no reader can still be looking at it.
+    RcuProtected<std::shared_ptr<ReadTransaction> > defaultTransaction;
 
     /// Control the quantization of timestamp (default is quantize to second)
     double timeQuantumSeconds;
@@ -206,7 +218,7 @@ struct SparseMatrixDataset::Itl
     std::shared_ptr<ReadTransaction>
     getReadTransaction() const
     {
-        std::shared_ptr<ReadTransaction> result = defaultTransaction.load();
+        std::shared_ptr<ReadTransaction> result = *defaultTransaction();
 
         // Assertion failures here mean problems with the MVCC mechanism
         ExcAssert(result->matrix);
@@ -224,7 +236,8 @@ struct SparseMatrixDataset::Itl
         ExcAssert(trans->inverse);
         ExcAssert(trans->values);
         
-        defaultTransaction.store(std::move(trans));
+        defaultTransaction.replace
+            (new std::shared_ptr<ReadTransaction>(std::move(trans)));
     }
 
     /// Obtain a new write transaction based upon a current read transaction
@@ -237,6 +250,20 @@ struct SparseMatrixDataset::Itl
     /// Commit a set of writes to the database
     void commitWrites(WriteTransaction & trans)
     {
+        if (!trans.matrix->commitIsVisible()
+            && !trans.inverse->commitIsVisible()
+            && !trans.values->commitIsVisible()) {
+            // The writes won't be read until the next optimize(), so the
+            // version that readers see doesn't change and writers don't
+            // need to be serialized; they only need to keep out of the
+            // way of an optimize() so that it sees all or none of them.
+            std::shared_lock<RootLock> guard(rootLock);
+            trans.matrix->commit();
+            trans.inverse->commit();
+            trans.values->commit();
+            return;
+        }
+
         std::unique_lock<RootLock> guard(rootLock);
         ++epoch;
 
@@ -797,6 +824,39 @@ struct SparseMatrixDataset::Itl
         auto trans = getReadTransaction();
         return getColumnTrans(column, *trans);
     }
+
+    /** Return the value of the column for all rows, ignoring timestamps.
+        The filter is applied to the values before the names of their rows
+        are looked up, so that a selective filter is cheap.
+    */
+    virtual std::vector<std::tuple<RowPath, CellValue> >
+    getColumnValues(const ColumnPath & column,
+                    const std::function<bool (const CellValue &)> & filter) const override
+    {
+        auto trans = getReadTransaction();
+
+        std::vector<std::tuple<RowHash, CellValue> > matching;
+        auto onEntry = [&] (const BaseEntry & entry)
+            {
+                CellValue v = decodeVal(entry.val, entry.tag, *trans);
+                if (!filter || filter(v))
+                    matching.emplace_back(RowHash(entry.rowcol), std::move(v));
+                return true;
+            };
+
+        trans->inverse->iterateRow(column.hash(), onEntry);
+
+        std::vector<std::tuple<RowPath, CellValue> > result;
+        result.reserve(matching.size());
+        for (auto & m: matching) {
+            result.emplace_back(getRowPathTrans(std::get<0>(m), *trans),
+                                std::move(std::get<1>(m)));
+        }
+
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+    }
     
     static void
     recordRowTrans(const RowPath & rowName,
@@ -1044,7 +1104,8 @@ commit()
     // We call commit() when we're done with writing data.  We take advantage
     // of it to optimize the storage of the data that's been recorded to
     // date.
-    return itl->optimize();
+    itl->optimize();
+    dataChanged();
 }
     
 Date
@@ -1152,7 +1213,6 @@ struct MutableBaseData {
 
         std::vector<std::shared_ptr<const RowsEntry> > entries;
         mutable std::atomic<int64_t> cachedRowCount;
-        mutable std::mutex rowCountMutex;
         
         bool iterateRow(uint64_t rowNum,
                         const std::function<bool (const BaseEntry & entry)> & onEntry) const
@@ -1218,8 +1278,9 @@ struct MutableBaseData {
             if (r != -1)
                 return r;
 
-            // TODO: this is slow, but at least correct
-            std::unique_lock<std::mutex> guard(rowCountMutex);
+            // TODO: this is slow, but at least correct.  Concurrent
+            // callers may each count, but they all get the same answer
+            // so there is no need to hold them up behind a lock.
             std::vector<uint64_t> allRows;
 
             for (auto & e: entries) {
@@ -1582,6 +1643,11 @@ struct MutableWriteTransaction: public MatrixWriteTransaction {
         data->insert(written);
     }
 
+    virtual bool commitIsVisible() const
+    {
+        return data->commitMode != READ_ON_COMMIT;
+    }
+
     virtual std::shared_ptr<MatrixWriteTransaction>
     startWriteTransaction() const
     {
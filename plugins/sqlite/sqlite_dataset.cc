@@ -12,6 +12,9 @@
 #include "mldb/arch/simd_vector.h"
 #include "mldb/base/parallel.h"
 #include "mldb/sql/sql_expression.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/sql/sql_utils.h"
+#include "mldb/sql/expression_value.h"
 #include "mldb/ext/sqlite/sqlite3.h"
 #include "mldb/ext/sqlite/sqlite3pp.h"
 #include "mldb/ext/sqlite/sqlite3ppext.h"
@@ -91,6 +94,55 @@ struct Init {
     }
 } init;
 
+/** Return the SQLite string literal for val in result, or false if it
+    contains a nul character and so can't be represented as one.
+*/
+bool sqlQuote(const std::string & val, std::string & result)
+{
+    result = "'";
+    for (char c: val) {
+        if (c == 0)
+            return false;
+        if (c == '\'')
+            result += '\'';
+        result += c;
+    }
+    result += '\'';
+    return true;
+}
+
+/** Return the SQLite literal for the value as it's stored in the vals
+    table, which is its JSON encoding.
+*/
+bool sqlQuoteStored(const CellValue & val, std::string & result)
+{
+    return sqlQuote(jsonEncodeUtf8(val).rawString(), result);
+}
+
+/** Return the SQLite literal for a finite number, or false if val isn't
+    one.
+*/
+bool sqlNumber(const CellValue & val, std::string & result)
+{
+    if (!val.isNumber() || val.isNaN() || val.isInf())
+        return false;
+    if (val.isInteger()) {
+        result = val.isInt64() ? std::to_string(val.toInt())
+            : std::to_string(val.toUInt());
+    }
+    else result = MLDB::format("%.17g", val.toDouble());
+    return true;
+}
+
+/// The value of expr, if it's a constant atom
+const CellValue * getConstantAtom(const SqlExpression & expr)
+{
+    auto constant = dynamic_cast<const ConstantExpression *>(&expr);
+    if (!constant || !constant->constant.isAtom())
+        return nullptr;
+    return &constant->constant.getAtom();
+}
+
 } // namespace
 
 
@@ -554,6 +606,444 @@ struct SqliteSparseDataset::Itl
                                       RowHash(row), row);
     }
     
+    /// Return the number of each column in the cols table
+    std::vector<std::pair<int, ColumnPath> > getColumnNums() const
+    {
+        return runQuery<std::pair<int, Path> >("SELECT colNum, colName FROM cols");
+    }
+
+    /** A where clause translated into a condition on the rows table,
+        aliased as r.  If it's exact, the condition has the same value
+        (including null) as the where clause on every row; otherwise it's
+        true for at least the rows that match, which must be filtered
+        again.
+    */
+    struct Condition {
+        std::string sql;
+        bool exact;
+    };
+
+    /** Translation of where clauses into SQLite.  Each column is read as
+        its latest value from the vals table, with JSON null as an SQL
+        NULL.  Only atoms are compared, so a column that has others
+        under it (and so reads as a row) isn't translated.
+    */
+    struct WhereTranslator {
+        WhereTranslator(const Utf8String & alias,
+                        std::vector<std::pair<int, ColumnPath> > columns)
+            : alias(alias), columns(std::move(columns))
+        {
+        }
+
+        Utf8String alias;
+        std::vector<std::pair<int, ColumnPath> > columns;
+
+        static Condition inexact()
+        {
+            return { "1", false };
+        }
+
+        /** If expr reads a column whose value is an atom, set colNum to
+            its number (or -1 if there is no such column) and value to the
+            SQL that reads it for the current row.
+        */
+        bool getColumn(const SqlExpression & expr,
+                       int & colNum, std::string & value) const
+        {
+            auto read = dynamic_cast<const ReadColumnExpression *>(&expr);
+            if (!read)
+                return false;
+            ColumnPath columnName = removeTableName(alias, read->columnName);
+
+            colNum = -1;
+            for (auto & c: columns) {
+                if (c.second == columnName)
+                    colNum = c.first;
+                else if (c.second.startsWith(columnName))
+                    return false;
+            }
+
+            if (colNum == -1)
+                value = "NULL";
+            else value = "(SELECT NULLIF(val, 'null') FROM vals"
+                     " WHERE rowNum = r.rowNum AND colNum = "
+                     + std::to_string(colNum)
+                     + " ORDER BY ts DESC LIMIT 1)";
+            return true;
+        }
+
+        /// Condition that uses the bycol index to find the rows with a
+        /// value of the column, optionally restricted to the given ones
+        static std::string indexed(int colNum, const std::string & values)
+        {
+            std::string result
+                = "r.rowNum IN (SELECT rowNum FROM vals WHERE colNum = "
+                + std::to_string(colNum);
+            if (!values.empty())
+                result += " AND val IN (" + values + ")";
+            return result + ")";
+        }
+
+        /// Condition true when the value is null or isn't a number, which
+        /// compares as greater than all numbers
+        static std::string notNumeric(const std::string & value)
+        {
+            return value + " NOT GLOB '[-0-9]*'";
+        }
+
+        Condition translate(const SqlExpression & expr) const
+        {
+            if (auto boolean
+                = dynamic_cast<const BooleanOperatorExpression *>(&expr)) {
+                Condition r = translate(*boolean->rhs);
+                if (boolean->op == "NOT" && !boolean->lhs) {
+                    // NOT is only a superset of NOT of a superset if
+                    // it's exact
+                    if (!r.exact)
+                        return inexact();
+                    return { "(NOT " + r.sql + ")", true };
+                }
+                if (!boolean->lhs)
+                    return inexact();
+                Condition l = translate(*boolean->lhs);
+                if (boolean->op == "AND") {
+                    return { "(" + l.sql + " AND " + r.sql + ")",
+                             l.exact && r.exact };
+                }
+                if (boolean->op == "OR") {
+                    return { "(" + l.sql + " OR " + r.sql + ")",
+                             l.exact && r.exact };
+                }
+                return inexact();
+            }
+
+            if (auto constant = dynamic_cast<const ConstantExpression *>(&expr)) {
+                const ExpressionValue & val = constant->constant;
+                if (val.empty())
+                    return { "NULL", true };
+                if (val.isAtom() && val.getAtom().isNumber())
+                    return { val.isTrue() ? "1" : "0", true };
+                return inexact();
+            }
+
+            if (auto comparison
+                = dynamic_cast<const ComparisonExpression *>(&expr)) {
+                return translateComparison(*comparison);
+            }
+
+            if (auto isType = dynamic_cast<const IsTypeExpression *>(&expr)) {
+                int colNum;
+                std::string value;
+                if (isType->type != "null"
+                    || !getColumn(*isType->expr, colNum, value))
+                    return inexact();
+                if (isType->notType) {
+                    if (colNum == -1)
+                        return { "0", true };
+                    return { "(" + indexed(colNum, "") + " AND "
+                             + value + " IS NOT NULL)", true };
+                }
+                return { "(" + value + " IS NULL)", true };
+            }
+
+            if (auto in = dynamic_cast<const InExpression *>(&expr)) {
+                int colNum;
+                std::string value, values;
+                if (in->kind != InExpression::TUPLE
+                    || in->tuple->clauses.empty()
+                    || !getColumn(*in->expr, colNum, value))
+                    return inexact();
+                for (auto & c: in->tuple->clauses) {
+                    const CellValue * atom = getConstantAtom(*c);
+                    std::string literal;
+                    if (!atom || atom->empty() || atom->isNaN()
+                        || !sqlQuoteStored(*atom, literal))
+                        return inexact();
+                    if (!values.empty())
+                        values += ", ";
+                    values += literal;
+                }
+                if (colNum == -1)
+                    return { "NULL", true };
+                if (in->isNegative)
+                    return { "(" + value + " NOT IN (" + values + "))", true };
+                return { "(" + indexed(colNum, values) + " AND "
+                         + value + " IN (" + values + "))", true };
+            }
+
+            if (auto between = dynamic_cast<const BetweenExpression *>(&expr)) {
+                int colNum;
+                std::string value, lower, upper;
+                const CellValue * l = getConstantAtom(*between->lower);
+                const CellValue * u = getConstantAtom(*between->upper);
+                if (between->notBetween || !l || !u
+                    || !sqlNumber(*l, lower) || !sqlNumber(*u, upper)
+                    || !getColumn(*between->expr, colNum, value))
+                    return inexact();
+                if (colNum == -1)
+                    return { "NULL", true };
+                return { "(" + value + " IS NOT NULL AND ("
+                         + notNumeric(value) + " OR CAST(" + value
+                         + " AS NUMERIC) BETWEEN " + lower + " AND "
+                         + upper + "))", false };
+            }
+
+            if (auto like = dynamic_cast<const LikeExpression *>(&expr)) {
+                int colNum;
+                std::string value, pattern;
+                const CellValue * p = getConstantAtom(*like->right);
+                if (like->isNegative || !p || !p->isString()
+                    || !getColumn(*like->left, colNum, value))
+                    return inexact();
+
+                // The stored value is a JSON string, which we can match
+                // by putting quotes around the pattern as long as it has
+                // no characters that JSON escapes; _ could match a single
+                // character that is escaped into several.  SQLite's LIKE
+                // ignores case, which only makes it a bigger superset.
+                std::string str = p->toUtf8String().rawString();
+                for (unsigned char c: str) {
+                    if (c < ' ' || c >= 127 || c == '"' || c == '\\'
+                        || c == '_')
+                        return inexact();
+                }
+                if (!sqlQuote("\"" + str + "\"", pattern))
+                    return inexact();
+                if (colNum == -1)
+                    return { "NULL", true };
+                return { "(" + value + " IS NOT NULL AND (" + value
+                         + " NOT GLOB '\"*' OR " + value + " LIKE "
+                         + pattern + "))", false };
+            }
+
+            return inexact();
+        }
+
+        Condition translateComparison(const ComparisonExpression & comparison) const
+        {
+            // Put the constant on the right
+            const SqlExpression * lhs = comparison.lhs.get();
+            const SqlExpression * rhs = comparison.rhs.get();
+            std::string op = comparison.op;
+            if (getConstantAtom(*lhs)) {
+                std::swap(lhs, rhs);
+                if (op[0] == '<')
+                    op[0] = '>';
+                else if (op[0] == '>')
+                    op[0] = '<';
+            }
+
+            const CellValue * constant = getConstantAtom(*rhs);
+            if (!constant)
+                return inexact();
+            if (constant->empty())
+                return { "NULL", true };
+
+            auto function = dynamic_cast<const FunctionCallExpression *>(lhs);
+            if (function && function->functionName == "rowName"
+                && function->args.empty()
+                && (op == "=" || op == "==")) {
+                std::string name;
+                if (!constant->isString())
+                    return { "0", true };
+                if (!sqlQuote(constant->toUtf8String().rawString(), name))
+                    return inexact();
+                return { "(r.rowName = " + name + ")", true };
+            }
+
+            int colNum;
+            std::string value;
+            if (!getColumn(*lhs, colNum, value))
+                return inexact();
+
+            if (op == "=" || op == "==" || op == "!=") {
+                // Equal values have the same JSON encoding, except for
+                // NaN which isn't equal to itself
+                std::string literal;
+                if (constant->isNaN() || !sqlQuoteStored(*constant, literal))
+                    return inexact();
+                if (colNum == -1)
+                    return { "NULL", true };
+                if (op == "!=")
+                    return { "(" + value + " != " + literal + ")", true };
+                return { "(" + indexed(colNum, literal) + " AND "
+                         + value + " = " + literal + ")", true };
+            }
+
+            std::string number;
+            if (!sqlNumber(*constant, number))
+                return inexact();
+            if (colNum == -1)
+                return { "NULL", true };
+            return { "(" + value + " IS NOT NULL AND (" + notNumeric(value)
+                     + " OR CAST(" + value + " AS NUMERIC) " + op + " "
+                     + number + "))", false };
+        }
+    };
+
+    Condition translateWhere(const Utf8String & alias,
+                             const SqlExpression & where) const
+    {
+        WhereTranslator translator(alias, getColumnNums());
+        return translator.translate(where);
+    }
+
+    /** Return the names of the rows for which the condition is true, in
+        a deterministic order.
+    */
+    std::vector<RowPath>
+    getRowsWhere(const Condition & condition,
+                 ssize_t offset, ssize_t limit) const
+    {
+        string query = "SELECT rowName FROM rows r WHERE " + condition.sql
+            + " ORDER BY rowNum";
+        if (limit != -1 || offset != 0)
+            query += " LIMIT " + to_string(limit);
+        if (offset != 0)
+            query += " OFFSET " + to_string(offset);
+        return runQuery<RowPath>(query);
+    }
+
+    std::function<ExpressionValue (const RowPath & row)>
+    getRowExprProjection(const UnboundEntities & unbound,
+                         const Utf8String & alias) const
+    {
+        if (!unbound.wildcards.empty()
+            || unbound.funcs.count("columnCount"))
+            return nullptr;
+
+        // Variables scoped by a table name are only there in joins and
+        // sub-selects, where we don't try to work it out.
+        for (auto & t: unbound.tables) {
+            if (!t.second.vars.empty() || !t.second.wildcards.empty()
+                || t.second.funcs.count(PathElement("columnCount")))
+                return nullptr;
+        }
+
+        std::vector<ColumnPath> read;
+        for (auto & v: unbound.vars) {
+            read.emplace_back(removeTableName(alias, v.first));
+        }
+
+        std::string colNums;
+        for (auto & c: getColumnNums()) {
+            for (auto & r: read) {
+                if (c.second.startsWith(r)) {
+                    if (!colNums.empty())
+                        colNums += ",";
+                    colNums += std::to_string(c.first);
+                    break;
+                }
+            }
+        }
+
+        if (colNums.empty()) {
+            return [] (const RowPath & row)
+                {
+                    return ExpressionValue
+                        (std::vector<std::tuple<ColumnPath, CellValue, Date> >());
+                };
+        }
+
+        std::string query
+            = "SELECT cols.colName, vals.val, vals.ts FROM vals"
+            " JOIN cols ON vals.colNum = cols.colNum"
+            " WHERE rowNum = (SELECT rowNum FROM rows WHERE rowHash = ? AND rowName = ?)"
+            " AND vals.colNum IN (" + colNums + ")";
+
+        return [=] (const RowPath & row)
+            {
+                return ExpressionValue
+                    (runQuery<std::tuple<ColumnPath, CellValue, Date> >
+                     (query, RowHash(row),
+                      row.toUtf8String().rawString().c_str()));
+            };
+    }
+
+    bool
+    pushdownAggregators(const Utf8String & alias,
+                        const SqlExpression & where,
+                        const std::vector<std::shared_ptr<SqlExpression> > & aggregators,
+                        std::vector<ExpressionValue> & results,
+                        uint64_t & numRows) const
+    {
+        WhereTranslator translator(alias, getColumnNums());
+        Condition condition = translator.translate(where);
+        if (!condition.exact)
+            return false;
+
+        // Only count() is calculated, which needs the number of rows for
+        // a constant and otherwise the number of rows whose latest value
+        // of the column isn't null, with the latest of their timestamps.
+        std::vector<std::string> queries;
+        for (auto & a: aggregators) {
+            auto function = dynamic_cast<const FunctionCallExpression *>(a.get());
+            if (!function || function->functionName != "count"
+                || function->args.size() != 1)
+                return false;
+
+            auto constant = dynamic_cast<const ConstantExpression *>
+                (function->args[0].get());
+            if (constant && !constant->constant.empty()) {
+                queries.emplace_back();
+                continue;
+            }
+
+            int colNum;
+            std::string value;
+            if (!translator.getColumn(*function->args[0], colNum, value))
+                return false;
+            if (colNum == -1) {
+                queries.emplace_back("SELECT 0, NULL");
+                continue;
+            }
+
+            std::string col = std::to_string(colNum);
+            queries.emplace_back
+                ("SELECT count(DISTINCT r.rowNum), max(v.ts) FROM rows r"
+                 " JOIN vals v ON v.rowNum = r.rowNum AND v.colNum = " + col
+                 + " AND v.val != 'null' AND v.ts = (SELECT max(ts) FROM vals"
+                 " WHERE rowNum = r.rowNum AND colNum = " + col + ")"
+                 " WHERE " + condition.sql);
+        }
+
+        auto db = connectionPool.getConnection();
+
+        auto runCount = [&] (const std::string & queryStr, Date & ts)
+            {
+                sqlite3pp::query query(*db, queryStr.c_str());
+                auto it = query.begin();
+                ExcAssert(it != query.end());
+                uint64_t count = (*it).get<long long>(0);
+                ts = (*it).column_type(1) == SQLITE_NULL
+                    ? Date::negativeInfinity()
+                    : decodeTs((*it).get<long long>(1));
+                return count;
+            };
+
+        Date ts;
+        numRows = runCount("SELECT count(*), NULL FROM rows r WHERE "
+                           + condition.sql, ts);
+
+        results.clear();
+        for (size_t i = 0;  i < aggregators.size();  ++i) {
+            if (queries[i].empty()) {
+                auto function = dynamic_cast<const FunctionCallExpression *>
+                    (aggregators[i].get());
+                auto constant = dynamic_cast<const ConstantExpression *>
+                    (function->args[0].get());
+                results.emplace_back(numRows, numRows
+                                     ? constant->constant.getEffectiveTimestamp()
+                                     : Date::negativeInfinity());
+                continue;
+            }
+            uint64_t count = runCount(queries[i], ts);
+            results.emplace_back(count, ts);
+        }
+
+        return true;
+    }
+
     virtual int getRowNum(sqlite3pp::database & db, const RowPath & rowName)
     {
         RowHash rowHash(rowName);
@@ -812,7 +1302,8 @@ void
 SqliteSparseDataset::
 commit()
 {
-    return itl->commit();
+    itl->commit();
+    dataChanged();
 }
     
 std::pair<Date, Date>
@@ -829,6 +1320,71 @@ quantizeTimestamp(Date timestamp) const
     return itl->quantizeTimestamp(timestamp);
 }
 
+GenerateRowsWhereFunction
+SqliteSparseDataset::
+generateRowsWhere(const SqlBindingScope & context,
+                  const Utf8String & alias,
+                  const SqlExpression & where,
+                  ssize_t offset,
+                  ssize_t limit) const
+{
+    auto condition = itl->translateWhere(alias, where);
+    if (condition.sql == "1")
+        return Dataset::generateRowsWhere(context, alias, where, offset, limit);
+
+    auto itl = this->itl;
+    if (condition.exact) {
+        return {[=] (ssize_t numToGenerate, Any token,
+                     const BoundParameters & params,
+                     const ProgressFunc & onProgress)
+                -> std::pair<std::vector<RowPath>, Any>
+                {
+                    return { itl->getRowsWhere(condition, offset, limit),
+                             Any() };
+                },
+                "sqlite query for " + where.print(),
+                GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
+    }
+
+    // The rows found by the query need to be checked against the where
+    // clause, so the offset and limit can't be applied by it
+    GenerateRowsWhereFunction gen
+        {[=] (ssize_t numToGenerate, Any token,
+              const BoundParameters & params,
+              const ProgressFunc & onProgress)
+         -> std::pair<std::vector<RowPath>, Any>
+         {
+             return { itl->getRowsWhere(condition, 0, -1), Any() };
+         },
+         "sqlite query for superset of " + where.print(),
+         GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
+
+    return generateFilteredRows(*this, alias, std::move(gen), where);
+}
+
+std::function<ExpressionValue (const RowPath & row)>
+SqliteSparseDataset::
+getRowExprProjection(const UnboundEntities & unbound,
+                     const Utf8String & alias) const
+{
+    auto result = itl->getRowExprProjection(unbound, alias);
+    if (!result)
+        return Dataset::getRowExprProjection(unbound, alias);
+    return result;
+}
+
+bool
+SqliteSparseDataset::
+pushdownAggregators(const Utf8String & alias,
+                    const SqlExpression & where,
+                    const std::vector<std::shared_ptr<SqlExpression> > & aggregators,
+                    std::vector<ExpressionValue> & results,
+                    uint64_t & numRows) const
+{
+    return itl->pushdownAggregators(alias, where, aggregators, results,
+                                    numRows);
+}
+
 std::shared_ptr<MatrixView>
 SqliteSparseDataset::
 getMatrixView() const
@@ -61,6 +61,30 @@ struct SqliteSparseDataset: public Dataset {
     virtual std::shared_ptr<ColumnIndex> getColumnIndex() const;
     virtual std::shared_ptr<RowStream> getRowStream() const { return std::shared_ptr<RowStream>(); }
 
+    /** Translate as much of the where clause as possible into a query
+        of the database, so that only the matching rows are read.
+    */
+    virtual GenerateRowsWhereFunction
+    generateRowsWhere(const SqlBindingScope & context,
+                      const Utf8String & alias,
+                      const SqlExpression & where,
+                      ssize_t offset,
+                      ssize_t limit) const;
+
+    virtual std::function<ExpressionValue (const RowPath & row)>
+    getRowExprProjection(const UnboundEntities & unbound,
+                         const Utf8String & alias) const;
+
+    /** Calculate count() aggregators with a query of the database, when
+        the where clause can be translated into one exactly.
+    */
+    virtual bool
+    pushdownAggregators(const Utf8String & alias,
+                        const SqlExpression & where,
+                        const std::vector<std::shared_ptr<SqlExpression> > & aggregators,
+                        std::vector<ExpressionValue> & results,
+                        uint64_t & numRows) const;
+
     virtual std::pair<Date, Date> getTimestampRange() const;
     virtual Date quantizeTimestamp(Date timestamp) const;
 
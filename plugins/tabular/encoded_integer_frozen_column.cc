@@ -0,0 +1,995 @@
+/** encoded_integer_frozen_column.cc                              -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Frozen column formats for integer-valued columns that exploit the
+    order of the values: run-length encoding for columns with long runs
+    of the same value, and frame-of-reference delta encoding for columns
+    whose values change slowly, like sorted ids or timestamps.
+*/
+
+#include "frozen_tables.h"
+#include "frozen_column.h"
+#include "tabular_dataset_column.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/types/basic_value_descriptions.h"
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/// Number of values decoded at once into temporary buffers
+constexpr size_t DECODE_BLOCK_SIZE = 256;
+
+/** Find the minimum and maximum value of a column that contains only
+    integers and nulls.  Returns false if the column has something else,
+    no values at all, or values that don't fit in a signed 64 bit integer.
+*/
+bool getIntegerRange(const TabularDatasetColumn & column,
+                     int64_t & minValue, int64_t & maxValue)
+{
+    if (!column.columnTypes.onlyIntegersAndNulls()
+        || column.columnTypes.maxPositiveInteger
+           > (uint64_t)std::numeric_limits<int64_t>::max()
+        || column.indexedVals.empty())
+        return false;
+
+    minValue = std::numeric_limits<int64_t>::max();
+    maxValue = std::numeric_limits<int64_t>::min();
+    for (auto & v: column.indexedVals) {
+        int64_t i = v.toInt();
+        minValue = std::min(minValue, i);
+        maxValue = std::max(maxValue, i);
+    }
+    return true;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* RUN LENGTH FROZEN COLUMN                                                  */
+/*****************************************************************************/
+
+struct RunLengthFrozenColumnMetadata {
+    uint64_t firstEntry = 0;
+    uint32_t numEntries = 0;
+    int64_t offset = 0;
+    /// The rows with a value are in the presence bitmap.  Otherwise
+    /// every row has a value.
+    bool hasPresence = false;
+    uint32_t numNonNullRows = 0;
+    ColumnTypes columnTypes;
+};
+
+IMPLEMENT_STRUCTURE_DESCRIPTION(RunLengthFrozenColumnMetadata)
+{
+    setVersion(1);
+    addField("firstEntry", &RunLengthFrozenColumnMetadata::firstEntry, "");
+    addField("numEntries", &RunLengthFrozenColumnMetadata::numEntries, "");
+    addField("offset", &RunLengthFrozenColumnMetadata::offset, "");
+    addField("hasPresence", &RunLengthFrozenColumnMetadata::hasPresence, "");
+    addField("numNonNullRows",
+             &RunLengthFrozenColumnMetadata::numNonNullRows, "");
+    addField("columnTypes", &RunLengthFrozenColumnMetadata::columnTypes, "");
+}
+
+/** Frozen column that stores an integer column as a list of runs of the
+    same value.  Each run is stored once as its starting row and its
+    value minus the offset.  Nulls are recorded in a presence bitmap and
+    take the value of the row before them, so that they extend the run
+    they interrupt rather than starting two new ones.
+*/
+struct RunLengthFrozenColumn
+    : public FrozenColumn,
+      public RunLengthFrozenColumnMetadata {
+
+    struct SizingInfo {
+        SizingInfo(const TabularDatasetColumn & column)
+        {
+            int64_t minValue, maxValue;
+            if (!getIntegerRange(column, minValue, maxValue))
+                return;
+
+            numEntries = column.maxRowNumber - column.minRowNumber + 1;
+            hasNulls = column.sparseIndexes.size() < numEntries;
+            numNonNullRows = column.sparseIndexes.size();
+            offset = minValue;
+
+            // Encode each distinct value once
+            std::vector<uint64_t> encoded;
+            encoded.reserve(column.indexedVals.size());
+            for (auto & v: column.indexedVals) {
+                encoded.push_back(uint64_t(v.toInt()) - uint64_t(offset));
+            }
+
+            bool inRun = false;
+            uint64_t currentValue = 0;
+            auto addRow = [&] (uint64_t rowNumber, uint64_t value)
+                {
+                    if (inRun && value == currentValue)
+                        return;
+                    runStarts.add(rowNumber);
+                    runValues.add(value);
+                    currentValue = value;
+                    inRun = true;
+                };
+
+            // Nulls continue the current run; leading nulls join the
+            // first one.
+            uint64_t doneRows = 0;
+            for (auto & v: column.sparseIndexes) {
+                if (doneRows < v.first && !inRun)
+                    addRow(doneRows, encoded[v.second]);
+                addRow(v.first, encoded[v.second]);
+                presence.set(v.first);
+                doneRows = v.first + 1;
+            }
+
+            bytesRequired = sizeof(RunLengthFrozenColumn)
+                + runStarts.bytesRequired() + runValues.bytesRequired();
+            if (hasNulls)
+                bytesRequired += presence.bytesRequired();
+        }
+
+        operator ssize_t () const
+        {
+            return bytesRequired;
+        }
+
+        ssize_t bytesRequired = -1;
+        int64_t offset = 0;
+        size_t numEntries = 0;
+        bool hasNulls = false;
+        uint32_t numNonNullRows = 0;
+
+        MutableIntegerTable runStarts;
+        MutableIntegerTable runValues;
+        MutablePresenceBitmap presence;
+    };
+
+    RunLengthFrozenColumn(TabularDatasetColumn & column,
+                          SizingInfo & info,
+                          MappedSerializer & serializer)
+    {
+        this->columnTypes = std::move(column.columnTypes);
+        ExcAssertNotEqual(info.bytesRequired, -1);
+
+        this->firstEntry = column.minRowNumber;
+        this->numEntries = info.numEntries;
+        this->offset = info.offset;
+        this->hasPresence = info.hasNulls;
+        this->numNonNullRows = info.numNonNullRows;
+
+        this->runStarts = info.runStarts.freeze(serializer);
+        this->runValues = info.runValues.freeze(serializer);
+        if (hasPresence)
+            this->presence = info.presence.freeze(serializer);
+    }
+
+    RunLengthFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<RunLengthFrozenColumnMetadata>
+            (reconstituter, *this);
+        runStarts.reconstitute(*reconstituter.getStructure("starts"));
+        runValues.reconstitute(*reconstituter.getStructure("values"));
+        if (hasPresence)
+            presence.reconstitute(*reconstituter.getStructure("presence"));
+    }
+
+    CellValue decode(uint64_t val) const
+    {
+        return CellValue(int64_t(val + offset));
+    }
+
+    /// Is the given row (relative to firstEntry) marked null by the
+    /// presence bitmap?
+    bool absent(uint64_t rowNumber) const
+    {
+        return hasPresence && !presence.test(rowNumber);
+    }
+
+    /// The presence bitmap, or null if every row has a value
+    const FrozenPresenceBitmap * getPresenceBitmap() const
+    {
+        return hasPresence ? &presence : nullptr;
+    }
+
+    size_t numRuns() const
+    {
+        return runStarts.size();
+    }
+
+    /// Row (relative to firstEntry) one past the end of the given run
+    uint64_t runEnd(size_t run) const
+    {
+        return run + 1 < numRuns() ? runStarts.get(run + 1) : numEntries;
+    }
+
+    /// Return the run that contains the row (relative to firstEntry)
+    size_t findRun(uint64_t rowNumber) const
+    {
+        // Binary search for the first run that starts after the row;
+        // the first run always starts at row zero.
+        size_t first = 1, last = numRuns();
+        while (first < last) {
+            size_t mid = first + (last - first) / 2;
+            if (runStarts.get(mid) <= rowNumber)
+                first = mid + 1;
+            else last = mid;
+        }
+        return first - 1;
+    }
+
+    /** Call onRun(begin, end, value) for each of the runs that overlap
+        rows [begin, end) relative to firstEntry, clipped to that range.
+        The run starts and values are decoded a block at a time so that
+        the bit extraction is sequential.
+    */
+    template<typename Fn>
+    bool forEachRun(uint64_t begin, uint64_t end, Fn && onRun) const
+    {
+        if (begin >= end)
+            return true;
+
+        uint64_t starts[DECODE_BLOCK_SIZE];
+        uint64_t values[DECODE_BLOCK_SIZE];
+
+        for (size_t b = findRun(begin);  b < numRuns();
+             b += DECODE_BLOCK_SIZE) {
+            size_t e = std::min(numRuns(), b + DECODE_BLOCK_SIZE);
+            runStarts.getRange(b, e, starts);
+            runValues.getRange(b, e, values);
+            uint64_t lastEnd = runEnd(e - 1);
+
+            for (size_t i = 0;  i < e - b;  ++i) {
+                uint64_t runBegin = std::max(begin, starts[i]);
+                uint64_t runEnd = i + 1 < e - b ? starts[i + 1] : lastEnd;
+                runEnd = std::min(end, runEnd);
+                if (!onRun(runBegin, runEnd, values[i]))
+                    return false;
+                if (runEnd == end)
+                    return true;
+            }
+        }
+
+        return true;
+    }
+
+    bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
+    {
+        auto onRun = [&] (uint64_t begin, uint64_t end, uint64_t val)
+            {
+                CellValue decoded = decode(val);
+                for (uint64_t i = begin;  i < end;  ++i) {
+                    if (absent(i)) {
+                        if (keepNulls && !onRow(i + firstEntry, CellValue()))
+                            return false;
+                        continue;
+                    }
+                    if (!onRow(i + firstEntry, decoded))
+                        return false;
+                }
+                return true;
+            };
+
+        return forEachRun(0, numEntries, onRun);
+    }
+
+    virtual std::string format() const
+    {
+        return "Ir";
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, false /* keep nulls */);
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, true /* keep nulls */);
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries || absent(rowIndex))
+            return result;
+        return decode(runValues.get(findRun(rowIndex)));
+    }
+
+    /** Decode rows [begin, end) into out, converting the value of each
+        run once with decodeOne and writing nullValue for rows outside the
+        column or not in the presence bitmap.
+    */
+    template<typename T, typename Fn>
+    void decodeRange(uint32_t begin, uint32_t end, T * out,
+                     const T & nullValue, Fn && decodeOne) const
+    {
+        uint32_t first, last;
+        std::tie(first, last) = clipRange(begin, end, firstEntry, numEntries);
+        std::fill(out, out + (first - begin), nullValue);
+
+        T * o = out + (first - begin);
+        auto onRun = [&] (uint64_t runBegin, uint64_t runEnd, uint64_t val)
+            {
+                T decoded = decodeOne(val);
+                o = std::fill_n(o, runEnd - runBegin, decoded);
+                return true;
+            };
+        forEachRun(first - firstEntry, last - firstEntry, onRun);
+
+        if (hasPresence) {
+            uint64_t present[DECODE_BLOCK_SIZE / 64];
+            for (uint32_t b = first;  b < last;  b += DECODE_BLOCK_SIZE) {
+                uint32_t e = std::min<uint64_t>(last, (uint64_t)b + DECODE_BLOCK_SIZE);
+                std::fill(present, present + DECODE_BLOCK_SIZE / 64, 0);
+                presence.getBits(b - firstEntry, e - firstEntry, present);
+                T * o = out + (b - begin);
+                for (uint32_t i = 0;  i < e - b;  ++i) {
+                    if (!((present[i / 64] >> (i % 64)) & 1))
+                        o[i] = nullValue;
+                }
+            }
+        }
+
+        std::fill(out + (last - begin), out + (end - begin), nullValue);
+    }
+
+    virtual void getRange(uint32_t begin, uint32_t end,
+                          CellValue * out) const
+    {
+        decodeRange(begin, end, out, CellValue(),
+                    [&] (uint64_t val) { return decode(val); });
+    }
+
+    virtual void getSelection(const uint32_t * rows, size_t numRows,
+                              CellValue * out) const
+    {
+        // The rows are in order, so we can start each search from the
+        // run of the previous row.
+        size_t run = 0;
+        for (size_t i = 0;  i < numRows;  ++i) {
+            if (rows[i] < firstEntry || rows[i] - firstEntry >= numEntries) {
+                out[i] = CellValue();
+                continue;
+            }
+            uint64_t rowNumber = rows[i] - firstEntry;
+            if (absent(rowNumber)) {
+                out[i] = CellValue();
+                continue;
+            }
+            if (rowNumber >= runEnd(run))
+                run = findRun(rowNumber);
+            out[i] = decode(runValues.get(run));
+        }
+    }
+
+    virtual bool getRangeInt64(uint32_t begin, uint32_t end, int64_t * out,
+                               int64_t nullValue) const
+    {
+        decodeRange(begin, end, out, nullValue,
+                    [&] (uint64_t val) -> int64_t
+                    {
+                        return int64_t(val + offset);
+                    });
+        return true;
+    }
+
+    virtual bool getRangeDouble(uint32_t begin, uint32_t end,
+                                double * out) const
+    {
+        double nullValue = std::numeric_limits<double>::quiet_NaN();
+        decodeRange(begin, end, out, nullValue,
+                    [&] (uint64_t val) -> double
+                    {
+                        return int64_t(val + offset);
+                    });
+        return true;
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    virtual bool isNull(uint32_t rowIndex) const
+    {
+        return presenceIsNull(getPresenceBitmap(), firstEntry, numEntries,
+                              rowIndex);
+    }
+
+    virtual void getPresence(uint32_t begin, uint32_t end,
+                             uint64_t * out) const
+    {
+        presenceGetBits(getPresenceBitmap(), firstEntry, numEntries,
+                        begin, end, out);
+    }
+
+    virtual size_t countNonNull(uint32_t begin, uint32_t end) const
+    {
+        return presenceCount(getPresenceBitmap(), firstEntry, numEntries,
+                             begin, end);
+    }
+
+    virtual size_t memusage() const
+    {
+        return sizeof(*this) + runStarts.memusage() + runValues.memusage()
+            + presence.memusage();
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        // Nulls repeat a value that's in a run, so only need to be added
+        // if there are any
+        if (hasPresence && presence.count() < numEntries && !fn(CellValue()))
+            return false;
+
+        auto onVal = [&] (uint64_t val) -> bool
+            {
+                return fn(decode(val));
+            };
+
+        return runValues.forEachDistinctValue(onVal);
+    }
+
+    virtual size_t nonNullRowCount() const override
+    {
+        return numNonNullRows;
+    }
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    virtual void serialize(StructuredSerializer & serializer) const
+    {
+        serializeMetadataT<RunLengthFrozenColumnMetadata>(serializer, *this);
+        runStarts.serialize(*serializer.newStructure("starts"));
+        runValues.serialize(*serializer.newStructure("values"));
+        if (hasPresence)
+            presence.serialize(*serializer.newStructure("presence"));
+    }
+
+    FrozenIntegerTable runStarts;
+    FrozenIntegerTable runValues;
+    FrozenPresenceBitmap presence;
+};
+
+struct RunLengthFrozenColumnFormat: public FrozenColumnFormat {
+
+    virtual ~RunLengthFrozenColumnFormat()
+    {
+    }
+
+    virtual std::string format() const override
+    {
+        return "Ir";
+    }
+
+    virtual bool isFeasible(const TabularDatasetColumn & column,
+                            const ColumnFreezeParameters & params,
+                            std::shared_ptr<void> & cachedInfo) const override
+    {
+        return column.columnTypes.onlyIntegersAndNulls()
+            && column.columnTypes.maxPositiveInteger
+            <= (uint64_t)std::numeric_limits<int64_t>::max();
+    }
+
+    virtual ssize_t columnSize(const TabularDatasetColumn & column,
+                               const ColumnFreezeParameters & params,
+                               ssize_t previousBest,
+                               std::shared_ptr<void> & cachedInfo) const override
+    {
+        auto info = std::make_shared<RunLengthFrozenColumn::SizingInfo>(column);
+        size_t result = info->bytesRequired;
+        cachedInfo = info;
+        return result;
+    }
+
+    virtual FrozenColumn *
+    freeze(TabularDatasetColumn & column,
+           MappedSerializer & serializer,
+           const ColumnFreezeParameters & params,
+           std::shared_ptr<void> cachedInfo) const override
+    {
+        auto infoCast
+            = std::static_pointer_cast<RunLengthFrozenColumn::SizingInfo>
+            (std::move(cachedInfo));
+        return new RunLengthFrozenColumn(column, *infoCast, serializer);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(StructuredReconstituter & reconstituter) const override
+    {
+        return new RunLengthFrozenColumn(reconstituter);
+    }
+};
+
+RegisterFrozenColumnFormatT<RunLengthFrozenColumnFormat> regRunLength;
+
+
+/*****************************************************************************/
+/* DELTA FROZEN COLUMN                                                       */
+/*****************************************************************************/
+
+struct DeltaFrozenColumnMetadata {
+    uint64_t firstEntry = 0;
+    uint32_t numEntries = 0;
+    int64_t offset = 0;
+    int64_t minDelta = 0;
+    /// The rows with a value are in the presence bitmap.  Otherwise
+    /// every row has a value.
+    bool hasPresence = false;
+    uint32_t numNonNullRows = 0;
+    ColumnTypes columnTypes;
+};
+
+IMPLEMENT_STRUCTURE_DESCRIPTION(DeltaFrozenColumnMetadata)
+{
+    setVersion(1);
+    addField("firstEntry", &DeltaFrozenColumnMetadata::firstEntry, "");
+    addField("numEntries", &DeltaFrozenColumnMetadata::numEntries, "");
+    addField("offset", &DeltaFrozenColumnMetadata::offset, "");
+    addField("minDelta", &DeltaFrozenColumnMetadata::minDelta, "");
+    addField("hasPresence", &DeltaFrozenColumnMetadata::hasPresence, "");
+    addField("numNonNullRows", &DeltaFrozenColumnMetadata::numNonNullRows,
+             "");
+    addField("columnTypes", &DeltaFrozenColumnMetadata::columnTypes, "");
+}
+
+/** Frozen column that stores a dense integer column as the difference
+    between each value and the previous one.  The rows are split into
+    blocks of DELTA_BLOCK_SIZE; each block stores its first value, and
+    the deltas from there on relative to the smallest one in the block,
+    bit packed with the fewest bits that hold them.  For a sorted column
+    with regular spacing, like timestamps, this is a few bits per row.
+
+    Nulls are recorded in a presence bitmap and repeat the value of the
+    row before them, so they are stored as a zero delta.
+*/
+struct DeltaFrozenColumn
+    : public FrozenColumn,
+      public DeltaFrozenColumnMetadata {
+
+    /// Number of rows per block.  Random access needs to add up the
+    /// deltas from the start of the block, so it should be kept small.
+    static constexpr uint32_t DELTA_BLOCK_SIZE = 64;
+
+    struct SizingInfo {
+        SizingInfo(const TabularDatasetColumn & column)
+        {
+            int64_t minValue, maxValue;
+            if (!getIntegerRange(column, minValue, maxValue))
+                return;
+
+            numEntries = column.maxRowNumber - column.minRowNumber + 1;
+            hasNulls = column.sparseIndexes.size() < numEntries;
+            numNonNullRows = column.sparseIndexes.size();
+
+            // Deltas need to fit in a signed 64 bit integer, which is
+            // guaranteed if the range does.
+            uint64_t range = uint64_t(maxValue) - uint64_t(minValue);
+            if (range >= (uint64_t(1) << 62))
+                return;
+
+            offset = minValue;
+            values.reserve(numEntries);
+            for (auto & v: column.sparseIndexes) {
+                int64_t val = column.indexedVals[v.second].toInt();
+                // Nulls before this row repeat the previous value, or
+                // this one if there is none
+                values.resize(v.first, values.empty() ? val : values.back());
+                values.push_back(val);
+                presence.set(v.first);
+            }
+            values.resize(numEntries, values.back());
+
+            minDelta = std::numeric_limits<int64_t>::max();
+            for (size_t i = 1;  i < numEntries;  ++i) {
+                if (i % DELTA_BLOCK_SIZE != 0)
+                    minDelta = std::min(minDelta, values[i] - values[i - 1]);
+            }
+            if (minDelta == std::numeric_limits<int64_t>::max())
+                minDelta = 0;  // no deltas at all
+
+            for (size_t b = 0;  b < numEntries;  b += DELTA_BLOCK_SIZE) {
+                size_t e = std::min<size_t>(numEntries, b + DELTA_BLOCK_SIZE);
+                int64_t blockMin = std::numeric_limits<int64_t>::max();
+                int64_t blockMax = std::numeric_limits<int64_t>::min();
+                for (size_t i = b + 1;  i < e;  ++i) {
+                    int64_t delta = values[i] - values[i - 1];
+                    blockMin = std::min(blockMin, delta);
+                    blockMax = std::max(blockMax, delta);
+                }
+                if (e == b + 1)
+                    blockMin = blockMax = minDelta;
+
+                bases.add(values[b] - offset);
+                blockMinDeltas.add(blockMin - minDelta);
+                bitOffsets.add(totalBits);
+                totalBits += uint64_t(bitsToHoldRange(blockMax - blockMin))
+                    * (e - b - 1);
+            }
+            bitOffsets.add(totalBits);
+
+            numWords = (totalBits + 63) / 64;
+            bytesRequired = sizeof(DeltaFrozenColumn)
+                + bases.bytesRequired() + blockMinDeltas.bytesRequired()
+                + bitOffsets.bytesRequired() + numWords * 8;
+            if (hasNulls)
+                bytesRequired += presence.bytesRequired();
+        }
+
+        operator ssize_t () const
+        {
+            return bytesRequired;
+        }
+
+        ssize_t bytesRequired = -1;
+        int64_t offset = 0;
+        int64_t minDelta = 0;
+        size_t numEntries = 0;
+        bool hasNulls = false;
+        uint32_t numNonNullRows = 0;
+        uint64_t totalBits = 0;
+        size_t numWords = 0;
+
+        std::vector<int64_t> values;
+        MutableIntegerTable bases;
+        MutableIntegerTable blockMinDeltas;
+        MutableIntegerTable bitOffsets;
+        MutablePresenceBitmap presence;
+    };
+
+    DeltaFrozenColumn(TabularDatasetColumn & column,
+                      SizingInfo & info,
+                      MappedSerializer & serializer)
+    {
+        this->columnTypes = std::move(column.columnTypes);
+        ExcAssertNotEqual(info.bytesRequired, -1);
+
+        this->firstEntry = column.minRowNumber;
+        this->numEntries = info.numEntries;
+        this->offset = info.offset;
+        this->minDelta = info.minDelta;
+        this->hasPresence = info.hasNulls;
+        this->numNonNullRows = info.numNonNullRows;
+        if (hasPresence)
+            this->presence = info.presence.freeze(serializer);
+
+        auto mutableDeltas = serializer.allocateWritableT<uint64_t>(info.numWords);
+        std::fill_n(mutableDeltas.data(), info.numWords, 0);
+
+        MLDB::Bit_Writer<uint64_t> writer(mutableDeltas.data());
+        const std::vector<int64_t> & values = info.values;
+        for (size_t b = 0;  b < numEntries;  b += DELTA_BLOCK_SIZE) {
+            size_t blockNum = b / DELTA_BLOCK_SIZE;
+            size_t e = std::min<size_t>(numEntries, b + DELTA_BLOCK_SIZE);
+            int64_t blockMin = info.blockMinDeltas.values[blockNum] + minDelta;
+            int bits = deltaBits(info.bitOffsets.values[blockNum],
+                                 info.bitOffsets.values[blockNum + 1],
+                                 e - b);
+            for (size_t i = b + 1;  i < e;  ++i) {
+                writer.write(values[i] - values[i - 1] - blockMin, bits);
+            }
+        }
+
+        this->deltas = mutableDeltas.freeze();
+        this->bases = info.bases.freeze(serializer);
+        this->blockMinDeltas = info.blockMinDeltas.freeze(serializer);
+        this->bitOffsets = info.bitOffsets.freeze(serializer);
+    }
+
+    DeltaFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<DeltaFrozenColumnMetadata>(reconstituter, *this);
+        bases.reconstitute(*reconstituter.getStructure("bases"));
+        blockMinDeltas.reconstitute(*reconstituter.getStructure("minDeltas"));
+        bitOffsets.reconstitute(*reconstituter.getStructure("bitOffsets"));
+        deltas = reconstituter.getRegionT<uint64_t>("deltas");
+        if (hasPresence)
+            presence.reconstitute(*reconstituter.getStructure("presence"));
+        else numNonNullRows = numEntries;
+    }
+
+    /// Is the given row (relative to firstEntry) marked null by the
+    /// presence bitmap?
+    bool absent(uint64_t rowNumber) const
+    {
+        return hasPresence && !presence.test(rowNumber);
+    }
+
+    /// The presence bitmap, or null if every row has a value
+    const FrozenPresenceBitmap * getPresenceBitmap() const
+    {
+        return hasPresence ? &presence : nullptr;
+    }
+
+    /// Number of bits per delta for a block with the given bit offsets
+    static int deltaBits(uint64_t startBit, uint64_t endBit, size_t numRows)
+    {
+        return numRows <= 1 ? 0 : (endBit - startBit) / (numRows - 1);
+    }
+
+    /** Decode rows [begin, end) of the block with the given number,
+        relative to the start of the block, into out.
+    */
+    void decodeBlock(size_t blockNum, uint32_t begin, uint32_t end,
+                     int64_t * out) const
+    {
+        size_t blockStart = blockNum * DELTA_BLOCK_SIZE;
+        size_t numRows = std::min<size_t>(numEntries - blockStart,
+                                          DELTA_BLOCK_SIZE);
+        ExcAssertLessEqual(end, numRows);
+
+        uint64_t startBit = bitOffsets.get(blockNum);
+        int bits = deltaBits(startBit, bitOffsets.get(blockNum + 1), numRows);
+        uint64_t delta = blockMinDeltas.get(blockNum) + minDelta;
+
+        // We do the arithmetic unsigned, as it wraps around in the same
+        // way that it did when the deltas were calculated.
+        uint64_t val = bases.get(blockNum) + offset;
+
+        MLDB::Bit_Extractor<uint64_t> extractor(deltas.data());
+        extractor.advance(startBit);
+
+        for (uint32_t i = 0;  i < end;  ++i) {
+            if (i > 0)
+                val += extractor.extract<uint64_t>(bits) + delta;
+            if (i >= begin)
+                *out++ = val;
+        }
+    }
+
+    /** Call onValue(rowNumber, value) for the rows [begin, end) relative
+        to firstEntry, decoding one block at a time.
+    */
+    template<typename Fn>
+    bool forEachValue(uint64_t begin, uint64_t end, Fn && onValue) const
+    {
+        int64_t buf[DELTA_BLOCK_SIZE];
+        for (uint64_t b = begin;  b < end;) {
+            size_t blockNum = b / DELTA_BLOCK_SIZE;
+            uint64_t blockStart = blockNum * DELTA_BLOCK_SIZE;
+            uint64_t e = std::min<uint64_t>(end, blockStart + DELTA_BLOCK_SIZE);
+            decodeBlock(blockNum, b - blockStart, e - blockStart, buf);
+            for (uint64_t i = b;  i < e;  ++i) {
+                if (!onValue(i, buf[i - b]))
+                    return false;
+            }
+            b = e;
+        }
+        return true;
+    }
+
+    virtual std::string format() const
+    {
+        return "Id";
+    }
+
+    bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
+    {
+        return forEachValue(0, numEntries,
+                            [&] (uint64_t i, int64_t val)
+                            {
+                                if (!absent(i))
+                                    return onRow(i + firstEntry, val);
+                                return !keepNulls
+                                    || onRow(i + firstEntry, CellValue());
+                            });
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, false /* keep nulls */);
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, true /* keep nulls */);
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries || absent(rowIndex))
+            return result;
+        int64_t val;
+        decodeBlock(rowIndex / DELTA_BLOCK_SIZE, rowIndex % DELTA_BLOCK_SIZE,
+                    rowIndex % DELTA_BLOCK_SIZE + 1, &val);
+        return val;
+    }
+
+    template<typename T, typename Fn>
+    void decodeRange(uint32_t begin, uint32_t end, T * out,
+                     const T & nullValue, Fn && decodeOne) const
+    {
+        uint32_t first, last;
+        std::tie(first, last) = clipRange(begin, end, firstEntry, numEntries);
+        std::fill(out, out + (first - begin), nullValue);
+
+        T * o = out + (first - begin);
+        forEachValue(first - firstEntry, last - firstEntry,
+                     [&] (uint64_t i, int64_t val)
+                     {
+                         *o++ = absent(i) ? nullValue : decodeOne(val);
+                         return true;
+                     });
+
+        std::fill(out + (last - begin), out + (end - begin), nullValue);
+    }
+
+    virtual void getRange(uint32_t begin, uint32_t end,
+                          CellValue * out) const
+    {
+        decodeRange(begin, end, out, CellValue(),
+                    [] (int64_t val) { return CellValue(val); });
+    }
+
+    virtual bool getRangeInt64(uint32_t begin, uint32_t end, int64_t * out,
+                               int64_t nullValue) const
+    {
+        decodeRange(begin, end, out, nullValue,
+                    [] (int64_t val) { return val; });
+        return true;
+    }
+
+    virtual bool getRangeDouble(uint32_t begin, uint32_t end,
+                                double * out) const
+    {
+        double nullValue = std::numeric_limits<double>::quiet_NaN();
+        decodeRange(begin, end, out, nullValue,
+                    [] (int64_t val) -> double { return val; });
+        return true;
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    virtual bool isNull(uint32_t rowIndex) const
+    {
+        return presenceIsNull(getPresenceBitmap(), firstEntry, numEntries,
+                              rowIndex);
+    }
+
+    virtual void getPresence(uint32_t begin, uint32_t end,
+                             uint64_t * out) const
+    {
+        presenceGetBits(getPresenceBitmap(), firstEntry, numEntries,
+                        begin, end, out);
+    }
+
+    virtual size_t countNonNull(uint32_t begin, uint32_t end) const
+    {
+        return presenceCount(getPresenceBitmap(), firstEntry, numEntries,
+                             begin, end);
+    }
+
+    virtual size_t memusage() const
+    {
+        return sizeof(*this) + bases.memusage() + blockMinDeltas.memusage()
+            + bitOffsets.memusage() + deltas.memusage() + presence.memusage();
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        if (hasPresence && presence.count() < numEntries && !fn(CellValue()))
+            return false;
+
+        std::vector<int64_t> allValues;
+        allValues.reserve(numEntries);
+        forEachValue(0, numEntries,
+                     [&] (uint64_t i, int64_t val)
+                     {
+                         if (!absent(i))
+                             allValues.push_back(val);
+                         return true;
+                     });
+        std::sort(allValues.begin(), allValues.end());
+        auto endIt = std::unique(allValues.begin(), allValues.end());
+
+        for (auto it = allValues.begin();  it != endIt;  ++it) {
+            if (!fn(*it))
+                return false;
+        }
+
+        return true;
+    }
+
+    virtual size_t nonNullRowCount() const override
+    {
+        return numNonNullRows;
+    }
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    virtual void serialize(StructuredSerializer & serializer) const
+    {
+        serializeMetadataT<DeltaFrozenColumnMetadata>(serializer, *this);
+        bases.serialize(*serializer.newStructure("bases"));
+        blockMinDeltas.serialize(*serializer.newStructure("minDeltas"));
+        bitOffsets.serialize(*serializer.newStructure("bitOffsets"));
+        serializer.addRegion(deltas, "deltas");
+        if (hasPresence)
+            presence.serialize(*serializer.newStructure("presence"));
+    }
+
+    FrozenIntegerTable bases;           ///< First value of each block
+    FrozenIntegerTable blockMinDeltas;  ///< Smallest delta in each block
+    FrozenIntegerTable bitOffsets;      ///< Start of each block's deltas
+    FrozenMemoryRegionT<uint64_t> deltas;
+    FrozenPresenceBitmap presence;
+};
+
+struct DeltaFrozenColumnFormat: public FrozenColumnFormat {
+
+    virtual ~DeltaFrozenColumnFormat()
+    {
+    }
+
+    virtual std::string format() const override
+    {
+        return "Id";
+    }
+
+    virtual bool isFeasible(const TabularDatasetColumn & column,
+                            const ColumnFreezeParameters & params,
+                            std::shared_ptr<void> & cachedInfo) const override
+    {
+        return column.columnTypes.onlyIntegersAndNulls()
+            && column.columnTypes.maxPositiveInteger
+            <= (uint64_t)std::numeric_limits<int64_t>::max();
+    }
+
+    virtual ssize_t columnSize(const TabularDatasetColumn & column,
+                               const ColumnFreezeParameters & params,
+                               ssize_t previousBest,
+                               std::shared_ptr<void> & cachedInfo) const override
+    {
+        auto info = std::make_shared<DeltaFrozenColumn::SizingInfo>(column);
+        size_t result = info->bytesRequired;
+        cachedInfo = info;
+        return result;
+    }
+
+    virtual FrozenColumn *
+    freeze(TabularDatasetColumn & column,
+           MappedSerializer & serializer,
+           const ColumnFreezeParameters & params,
+           std::shared_ptr<void> cachedInfo) const override
+    {
+        auto infoCast
+            = std::static_pointer_cast<DeltaFrozenColumn::SizingInfo>
+            (std::move(cachedInfo));
+        return new DeltaFrozenColumn(column, *infoCast, serializer);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(StructuredReconstituter & reconstituter) const override
+    {
+        return new DeltaFrozenColumn(reconstituter);
+    }
+};
+
+RegisterFrozenColumnFormatT<DeltaFrozenColumnFormat> regDelta;
+
+} // namespace MLDB
@@ -14,6 +14,7 @@
 #include "mldb/types/annotated_exception.h"
 #include "mldb/utils/atomic_shared_ptr.h"
 #include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/json_parsing.h"
 #include "mldb/arch/vm.h"
 #include "mldb/arch/endian.h"
 #include "mldb/vfs/filter_streams.h"
@@ -29,6 +30,48 @@ using namespace std;
 
 namespace MLDB {
 
+namespace {
+
+/// Number of values decoded at once into temporary buffers
+constexpr size_t DECODE_BLOCK_SIZE = 256;
+
+bool cellToDouble(const CellValue & val, double & out)
+{
+    if (val.empty())
+        out = std::numeric_limits<double>::quiet_NaN();
+    else if (val.isNumber())
+        out = val.toDouble();
+    else if (val.isTimestamp())
+        out = val.toTimestamp().secondsSinceEpoch();
+    else return false;
+    return true;
+}
+
+bool cellToInt64(const CellValue & val, int64_t & out, int64_t nullValue)
+{
+    if (val.empty())
+        out = nullValue;
+    else if (val.isInt64())
+        out = val.toInt();
+    else return false;
+    return true;
+}
+
+} // file scope
+
+std::pair<uint32_t, uint32_t>
+clipRange(uint32_t begin, uint32_t end,
+          uint64_t firstEntry, uint64_t numEntries)
+{
+    ExcAssertLessEqual(begin, end);
+    uint64_t first = std::min<uint64_t>(std::max<uint64_t>(begin, firstEntry),
+                                        end);
+    uint64_t last = std::max<uint64_t>(first,
+                                       std::min<uint64_t>(end,
+                                                          firstEntry + numEntries));
+    return { first, last };
+}
+
 
 /*****************************************************************************/
 /* DIRECT FROZEN COLUMN                                                      */
@@ -73,6 +116,12 @@ struct DirectFrozenColumn
         values = mutableValues.freeze(serializer);
     }
 
+    DirectFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<DirectFrozenColumnMetadata>(reconstituter, *this);
+        values.reconstitute(*reconstituter.getStructure("values"));
+    }
+
     virtual std::string format() const
     {
         return "d";
@@ -118,6 +167,17 @@ struct DirectFrozenColumn
         return values[rowIndex];
     }
 
+    virtual void getRange(uint32_t begin, uint32_t end,
+                          CellValue * out) const
+    {
+        uint32_t first, last;
+        std::tie(first, last) = clipRange(begin, end, firstEntry, values.size());
+        std::fill(out, out + (end - begin), CellValue());
+        for (uint32_t i = first;  i < last;  ++i) {
+            out[i - begin] = values[i - firstEntry];
+        }
+    }
+
     virtual size_t size() const
     {
         return numEntries;
@@ -234,7 +294,7 @@ struct DirectFrozenColumnFormat: public FrozenColumnFormat {
     virtual FrozenColumn *
     reconstitute(StructuredReconstituter & reconstituter) const override
     {
-        throw AnnotatedException(600, "Tabular reconstitution not finished");
+        return new DirectFrozenColumn(reconstituter);
     }
 };
 
@@ -315,6 +375,13 @@ struct TableFrozenColumn
         indexes = mutableIndexes.freeze(serializer);
     }
 
+    TableFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<TableFrozenColumnMetadata>(reconstituter, *this);
+        indexes.reconstitute(*reconstituter.getStructure("index"));
+        table.reconstitute(*reconstituter.getStructure("table"));
+    }
+
     virtual std::string format() const
     {
         return "T";
@@ -374,6 +441,29 @@ struct TableFrozenColumn
         }
     }
 
+    virtual void getRange(uint32_t begin, uint32_t end,
+                          CellValue * out) const
+    {
+        uint32_t first, last;
+        std::tie(first, last)
+            = clipRange(begin, end, firstEntry, indexes.size());
+        std::fill(out, out + (end - begin), CellValue());
+
+        uint64_t buf[DECODE_BLOCK_SIZE];
+        for (uint32_t b = first;  b < last;  b += DECODE_BLOCK_SIZE) {
+            uint32_t e = std::min<uint64_t>(last, (uint64_t)b + DECODE_BLOCK_SIZE);
+            indexes.getRange(b - firstEntry, e - firstEntry, buf);
+            CellValue * o = out + (b - begin);
+            for (uint32_t i = 0;  i < e - b;  ++i) {
+                uint64_t index = buf[i];
+                if (!hasNulls)
+                    o[i] = table[index];
+                else if (index != 0)
+                    o[i] = table[index - 1];
+            }
+        }
+    }
+
     virtual size_t size() const
     {
         return numEntries;
@@ -472,7 +562,7 @@ struct TableFrozenColumnFormat: public FrozenColumnFormat {
     virtual FrozenColumn *
     reconstitute(StructuredReconstituter & reconstituter) const override
     {
-        throw AnnotatedException(600, "Tabular reconstitution not finished");
+        return new TableFrozenColumn(reconstituter);
     }
 };
 
@@ -551,6 +641,14 @@ struct SparseTableFrozenColumn
         }
     }
 
+    SparseTableFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<SparseTableFrozenColumnMetadata>(reconstituter, *this);
+        table.reconstitute(*reconstituter.getStructure("table"));
+        rowNum.reconstitute(*reconstituter.getStructure("rn"));
+        index.reconstitute(*reconstituter.getStructure("idx"));
+    }
+
     virtual std::string format() const
     {
         return "ST";
@@ -646,6 +744,36 @@ struct SparseTableFrozenColumn
         return result;
     }
 
+    virtual void getRange(uint32_t begin, uint32_t end,
+                          CellValue * out) const
+    {
+        ExcAssertLessEqual(begin, end);
+        std::fill(out, out + (end - begin), CellValue());
+        if (end <= firstEntry)
+            return;
+
+        uint32_t rowBegin = std::max<uint64_t>(begin, firstEntry) - firstEntry;
+        uint32_t rowEnd = end - firstEntry;
+
+        // Find the first entry at or after rowBegin; the row numbers are
+        // stored in ascending order
+        uint32_t first = 0;
+        uint32_t last = numEntries();
+        while (first < last) {
+            uint32_t middle = (first + last) / 2;
+            if (rowNum.get(middle) < rowBegin)
+                first = middle + 1;
+            else last = middle;
+        }
+
+        for (uint32_t n = first;  n < numEntries();  ++n) {
+            uint64_t row = rowNum.get(n);
+            if (row >= rowEnd)
+                break;
+            out[row + firstEntry - begin] = table[index.get(n)];
+        }
+    }
+
     virtual size_t size() const
     {
         return lastEntry - firstEntry + 1;
@@ -755,7 +883,7 @@ struct SparseTableFrozenColumnFormat: public FrozenColumnFormat {
     virtual FrozenColumn *
     reconstitute(StructuredReconstituter & reconstituter) const override
     {
-        throw AnnotatedException(600, "Tabular reconstitution not finished");
+        return new SparseTableFrozenColumn(reconstituter);
     }
 };
 
@@ -767,7 +895,13 @@ RegisterFrozenColumnFormatT<SparseTableFrozenColumnFormat> regSparseTable;
 /*****************************************************************************/
 
 struct IntegerFrozenColumnMetadata {
+    /// Nulls are stored as a zero entry, and values shifted up by one.
+    /// This is only the case for columns saved by older versions; newer
+    /// ones use the presence bitmap instead.
     bool hasNulls = false;
+    /// The rows with a value are in the presence bitmap.  Otherwise
+    /// (unless hasNulls is set) every row has a value.
+    bool hasPresence = false;
     uint64_t firstEntry = 0;
     int64_t offset = 0;
     uint32_t numNonNullRows = 0;
@@ -776,8 +910,10 @@ struct IntegerFrozenColumnMetadata {
 
 IMPLEMENT_STRUCTURE_DESCRIPTION(IntegerFrozenColumnMetadata)
 {
-    setVersion(1);
+    setVersion(2);
     addField("hasNulls", &IntegerFrozenColumnMetadata::hasNulls, "");
+    addField("hasPresence", &IntegerFrozenColumnMetadata::hasPresence, "",
+             false);
     addField("firstEntry", &IntegerFrozenColumnMetadata::firstEntry, "");
     addField("offset", &IntegerFrozenColumnMetadata::offset, "");
     addField("nonNumNullRows",
@@ -834,37 +970,39 @@ struct IntegerFrozenColumn
             numEntries = column.maxRowNumber - column.minRowNumber + 1;
             hasNulls = column.sparseIndexes.size() < numEntries;
 
-            // If we have too much range to represent nulls then we can't
-            // use this kind of column.
-            if (range == -1 && hasNulls)
-                return;
-
             table.reserve(numEntries);
-            
+
+            // Nulls are recorded in the presence bitmap, and repeat the
+            // previous value in the table so that they don't extend its
+            // range or break a monotonic sequence.
             uint64_t doneRows = 0;
+            uint64_t lastVal = 0;
             for (auto & v: column.sparseIndexes) {
                 uint32_t rowNumber = v.first;
                 const CellValue & val = column.indexedVals[v.second];
-                uint64_t intVal = 0;
+                while (doneRows < rowNumber) {
+                    table.add(lastVal);  // for the null
+                    ++doneRows;
+                }
                 if (!val.empty()) {
-                    intVal = val.toInt() - offset + hasNulls;
+                    lastVal = val.toInt() - offset;
+                    presence.set(doneRows);
                     ++numNonNullRows;
                 }
-                while (rowNumber < doneRows) {
-                    table.add(0);  // for the null
-                    ++doneRows;
-                }
-                table.add(intVal);
+                else hasNulls = true;
+                table.add(lastVal);
                 ++doneRows;
             }
 
             // Handle nulls at the end
             while (doneRows < numEntries) {
-                table.add(0);  // for the null
+                table.add(lastVal);  // for the null
                 ++doneRows;
             }
 
             this->bytesRequired = table.bytesRequired() + sizeof(IntegerFrozenColumn);
+            if (hasNulls)
+                this->bytesRequired += presence.bytesRequired();
 
 #if 0
             cerr << "table.size() = " << table.size() << endl;
@@ -937,6 +1075,7 @@ struct IntegerFrozenColumn
         uint32_t numNonNullRows = 0;
 
         MutableIntegerTable table;
+        MutablePresenceBitmap presence;
     };
     
     IntegerFrozenColumn(TabularDatasetColumn & column,
@@ -947,7 +1086,10 @@ struct IntegerFrozenColumn
         ExcAssertNotEqual(info.bytesRequired, -1);
 
         this->firstEntry = column.minRowNumber;
-        this->hasNulls = info.hasNulls;
+        this->hasNulls = false;
+        this->hasPresence = info.hasNulls;
+        if (hasPresence)
+            this->presence = info.presence.freeze(serializer);
 
         this->table = info.table.freeze(serializer);
         this->offset = info.offset;
@@ -962,11 +1104,23 @@ struct IntegerFrozenColumn
             
     }
 
+    /// Is the given entry of the table marked null by the presence bitmap?
+    bool absent(size_t entry) const
+    {
+        return hasPresence && !presence.test(entry);
+    }
+
+    /// The presence bitmap, or null if every row has a value
+    const FrozenPresenceBitmap * getPresenceBitmap() const
+    {
+        return hasPresence ? &presence : nullptr;
+    }
+
     bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
     {
         auto onRow2 = [&] (size_t i, uint64_t val) -> bool
             {
-                CellValue decoded = decode(val);
+                CellValue decoded = absent(i) ? CellValue() : decode(val);
                 //cerr << "decoding " << val << " at entry " << i << " gave "
                 //     << decoded << endl;
                 if (decoded.empty() && !keepNulls)
@@ -977,6 +1131,14 @@ struct IntegerFrozenColumn
         return table.forEach(onRow2);
     }
     
+    IntegerFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<IntegerFrozenColumnMetadata>(reconstituter, *this);
+        table.reconstitute(*reconstituter.getStructure("table"));
+        if (hasPresence)
+            presence.reconstitute(*reconstituter.getStructure("presence"));
+    }
+
     virtual std::string format() const
     {
         return "I";
@@ -998,24 +1160,130 @@ struct IntegerFrozenColumn
         if (rowIndex < firstEntry)
             return result;
         rowIndex -= firstEntry;
-        if (rowIndex >= table.size())
+        if (rowIndex >= table.size() || absent(rowIndex))
             return result;
         return decode(table.get(rowIndex));
     }
 
+    /** Decode rows [begin, end) into out, converting each raw table value
+        with decodeOne and writing nullValue for rows outside the table
+        or not in the presence bitmap.  The table is decoded in blocks so
+        that the bit extraction runs sequentially.
+    */
+    template<typename T, typename Fn>
+    void decodeRange(uint32_t begin, uint32_t end, T * out,
+                     const T & nullValue, Fn && decodeOne) const
+    {
+        uint32_t first, last;
+        std::tie(first, last) = clipRange(begin, end, firstEntry, table.size());
+        std::fill(out, out + (first - begin), nullValue);
+
+        uint64_t buf[DECODE_BLOCK_SIZE];
+        uint64_t present[DECODE_BLOCK_SIZE / 64];
+        for (uint32_t b = first;  b < last;  b += DECODE_BLOCK_SIZE) {
+            uint32_t e = std::min<uint64_t>(last, (uint64_t)b + DECODE_BLOCK_SIZE);
+            table.getRange(b - firstEntry, e - firstEntry, buf);
+            T * o = out + (b - begin);
+            for (uint32_t i = 0;  i < e - b;  ++i) {
+                o[i] = decodeOne(buf[i]);
+            }
+            if (hasPresence) {
+                std::fill(present, present + DECODE_BLOCK_SIZE / 64, 0);
+                presence.getBits(b - firstEntry, e - firstEntry, present);
+                for (uint32_t i = 0;  i < e - b;  ++i) {
+                    if (!((present[i / 64] >> (i % 64)) & 1))
+                        o[i] = nullValue;
+                }
+            }
+        }
+
+        std::fill(out + (last - begin), out + (end - begin), nullValue);
+    }
+
+    virtual void getRange(uint32_t begin, uint32_t end,
+                          CellValue * out) const
+    {
+        decodeRange(begin, end, out, CellValue(),
+                    [&] (uint64_t val) { return decode(val); });
+    }
+
+    virtual void getSelection(const uint32_t * rows, size_t numRows,
+                              CellValue * out) const
+    {
+        for (size_t i = 0;  i < numRows;  ++i) {
+            out[i] = IntegerFrozenColumn::get(rows[i]);
+        }
+    }
+
+    virtual bool getRangeInt64(uint32_t begin, uint32_t end, int64_t * out,
+                               int64_t nullValue) const
+    {
+        decodeRange(begin, end, out, nullValue,
+                    [&] (uint64_t val) -> int64_t
+                    {
+                        return (val == 0 && hasNulls)
+                            ? nullValue : int64_t(val) + offset - hasNulls;
+                    });
+        return true;
+    }
+
+    virtual bool getRangeDouble(uint32_t begin, uint32_t end,
+                                double * out) const
+    {
+        double nullValue = std::numeric_limits<double>::quiet_NaN();
+        decodeRange(begin, end, out, nullValue,
+                    [&] (uint64_t val) -> double
+                    {
+                        return (val == 0 && hasNulls)
+                            ? nullValue : int64_t(val) + offset - hasNulls;
+                    });
+        return true;
+    }
+
     virtual size_t size() const
     {
         return table.size();
     }
 
+    virtual bool isNull(uint32_t rowIndex) const
+    {
+        if (hasNulls)
+            return FrozenColumn::isNull(rowIndex);
+        return presenceIsNull(getPresenceBitmap(), firstEntry, table.size(),
+                              rowIndex);
+    }
+
+    virtual void getPresence(uint32_t begin, uint32_t end,
+                             uint64_t * out) const
+    {
+        if (hasNulls)
+            return FrozenColumn::getPresence(begin, end, out);
+        presenceGetBits(getPresenceBitmap(), firstEntry, table.size(),
+                        begin, end, out);
+    }
+
+    virtual size_t countNonNull(uint32_t begin, uint32_t end) const
+    {
+        if (hasNulls)
+            return FrozenColumn::countNonNull(begin, end);
+        return presenceCount(getPresenceBitmap(), firstEntry, table.size(),
+                             begin, end);
+    }
+
     virtual size_t memusage() const
     {
-        return sizeof(*this) + table.memusage();
+        return sizeof(*this) + table.memusage() + presence.memusage();
     }
 
     virtual bool
     forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
     {
+        // Nulls repeat a value that's in the table, so only need to be
+        // added if there are any
+        if (hasPresence && presence.count() < table.size()
+            && !fn(CellValue()))
+            return false;
+
         auto onVal = [&] (uint64_t val) -> bool
             {
                 return fn(decode(val));
@@ -1030,6 +1298,7 @@ struct IntegerFrozenColumn
     }
 
     FrozenIntegerTable table;
+    FrozenPresenceBitmap presence;
 
     virtual ColumnTypes getColumnTypes() const
     {
@@ -1040,6 +1309,8 @@ struct IntegerFrozenColumn
     {
         serializeMetadataT<IntegerFrozenColumnMetadata>(serializer, *this);
         table.serialize(*serializer.newStructure("table"));
+        if (hasPresence)
+            presence.serialize(*serializer.newStructure("presence"));
     }
 };
 
@@ -1089,7 +1360,7 @@ struct IntegerFrozenColumnFormat: public FrozenColumnFormat {
     virtual FrozenColumn *
     reconstitute(StructuredReconstituter & reconstituter) const override
     {
-        throw AnnotatedException(600, "Tabular reconstitution not finished");
+        return new IntegerFrozenColumn(reconstituter);
     }
 };
 
@@ -1209,6 +1480,41 @@ struct DoubleFrozenColumn
         return storage[rowIndex];
     }
 
+    virtual void getRange(uint32_t begin, uint32_t end,
+                          CellValue * out) const
+    {
+        uint32_t first, last;
+        std::tie(first, last) = clipRange(begin, end, firstEntry, numEntries);
+        std::fill(out, out + (end - begin), CellValue());
+        for (uint32_t i = first;  i < last;  ++i) {
+            out[i - begin] = storage[i - firstEntry];
+        }
+    }
+
+    virtual void getSelection(const uint32_t * rows, size_t numRows,
+                              CellValue * out) const
+    {
+        for (size_t i = 0;  i < numRows;  ++i) {
+            out[i] = DoubleFrozenColumn::get(rows[i]);
+        }
+    }
+
+    virtual bool getRangeDouble(uint32_t begin, uint32_t end,
+                                double * out) const
+    {
+        uint32_t first, last;
+        std::tie(first, last) = clipRange(begin, end, firstEntry, numEntries);
+        double nullValue = std::numeric_limits<double>::quiet_NaN();
+        std::fill(out, out + (first - begin), nullValue);
+        // Null entries are stored as a NaN, so we can copy them over
+        // directly without testing
+        for (uint32_t i = first;  i < last;  ++i) {
+            out[i - begin] = storage[i - firstEntry].value();
+        }
+        std::fill(out + (last - begin), out + (end - begin), nullValue);
+        return true;
+    }
+
     virtual size_t size() const
     {
         return numEntries;
@@ -1286,6 +1592,12 @@ struct DoubleFrozenColumn
         return SizingInfo(column);
     }
 
+    DoubleFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<DoubleFrozenColumnMetadata>(reconstituter, *this);
+        storage = reconstituter.getRegionT<Entry>("doubles");
+    }
+
     virtual std::string format() const
     {
         return "D";
@@ -1336,7 +1648,7 @@ struct DoubleFrozenColumnFormat: public FrozenColumnFormat {
     virtual FrozenColumn *
     reconstitute(StructuredReconstituter & reconstituter) const override
     {
-        throw AnnotatedException(600, "Tabular reconstitution not finished");
+        return new DoubleFrozenColumn(reconstituter);
     }
 };
 
@@ -1365,23 +1677,46 @@ struct TimestampFrozenColumn
     // This stores the underlying doubles or CellValues 
     std::shared_ptr<const FrozenColumn> unwrapped;
 
+    /** Works out the best format for the unwrapped values of the column,
+        so that the freezer can compare it with the other formats that
+        are able to store timestamps.
+    */
+    struct SizingInfo {
+        SizingInfo(const TabularDatasetColumn & column,
+                   const ColumnFreezeParameters & params)
+        {
+            // Convert the values to unwrapped doubles
+            unwrapped.indexedVals.reserve(column.indexedVals.size());
+            for (auto & v: column.indexedVals) {
+                unwrapped.indexedVals.emplace_back(v.coerceToNumber());
+                unwrapped.columnTypes.update(unwrapped.indexedVals.back());
+            }
+            unwrapped.columnTypes.numNulls = column.columnTypes.numNulls;
+            unwrapped.sparseIndexes = column.sparseIndexes;
+            unwrapped.minRowNumber = column.minRowNumber;
+            unwrapped.maxRowNumber = column.maxRowNumber;
+
+            std::tie(bytesRequired, freezeUnwrapped)
+                = FrozenColumnFormat::preFreeze(unwrapped, params);
+            if (bytesRequired >= 0)
+                bytesRequired += sizeof(TimestampFrozenColumn);
+        }
+
+        ssize_t bytesRequired = -1;
+        TabularDatasetColumn unwrapped;
+        std::function<std::shared_ptr<FrozenColumn>
+                      (TabularDatasetColumn & column,
+                       MappedSerializer & serializer)> freezeUnwrapped;
+    };
+
     TimestampFrozenColumn(TabularDatasetColumn & column,
-                          MappedSerializer & serializer,
-                          const ColumnFreezeParameters & params)
+                          SizingInfo & info,
+                          MappedSerializer & serializer)
     {
         this->columnTypes = column.columnTypes;
         ExcAssert(!column.isFrozen);
-        // Convert the values to unwrapped doubles
-        column.valueIndex.clear();
-        size_t numNulls = column.columnTypes.numNulls;
-        column.columnTypes = ColumnTypes();
-        for (auto & v: column.indexedVals) {
-            v = v.coerceToNumber();
-            column.columnTypes.update(v);
-        }
-        column.columnTypes.numNulls = numNulls;
-
-        unwrapped = column.freeze(serializer, params);
+        ExcAssert(info.freezeUnwrapped);
+        unwrapped = info.freezeUnwrapped(info.unwrapped, serializer);
     }
 
     // Wrap a double (or null) into a timestamp (or null)
@@ -1417,6 +1752,54 @@ struct TimestampFrozenColumn
         return wrap(unwrapped->get(rowIndex));
     }
 
+    virtual void getRange(uint32_t begin, uint32_t end,
+                          CellValue * out) const
+    {
+        unwrapped->getRange(begin, end, out);
+        for (uint32_t i = 0;  i < end - begin;  ++i) {
+            out[i] = wrap(std::move(out[i]));
+        }
+    }
+
+    virtual void getSelection(const uint32_t * rows, size_t numRows,
+                              CellValue * out) const
+    {
+        unwrapped->getSelection(rows, numRows, out);
+        for (size_t i = 0;  i < numRows;  ++i) {
+            out[i] = wrap(std::move(out[i]));
+        }
+    }
+
+    virtual bool getRangeDouble(uint32_t begin, uint32_t end,
+                                double * out) const
+    {
+        // The underlying values are the seconds since the epoch
+        return unwrapped->getRangeDouble(begin, end, out);
+    }
+
+    // The unwrapped values are null exactly when the timestamps are
+    virtual bool isNull(uint32_t rowIndex) const
+    {
+        return unwrapped->isNull(rowIndex);
+    }
+
+    virtual void getPresence(uint32_t begin, uint32_t end,
+                             uint64_t * out) const
+    {
+        unwrapped->getPresence(begin, end, out);
+    }
+
+    virtual size_t countNonNull(uint32_t begin, uint32_t end) const
+    {
+        return unwrapped->countNonNull(begin, end);
+    }
+
+    virtual bool getRangeInt64(uint32_t begin, uint32_t end, int64_t * out,
+                               int64_t nullValue) const
+    {
+        return false;
+    }
+
     virtual size_t size() const
     {
         return unwrapped->size();
@@ -1449,9 +1832,16 @@ struct TimestampFrozenColumn
         return columnTypes;
     }
 
+    TimestampFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<TimestampFrozenColumnMetadata>(reconstituter, *this);
+        unwrapped = FrozenColumn::reconstitute
+            (*reconstituter.getStructure("ul"));
+    }
+
     virtual std::string format() const
     {
-        return "T";
+        return "Timestamp";
     }
 
     virtual void serialize(StructuredSerializer & serializer) const
@@ -1485,8 +1875,11 @@ struct TimestampFrozenColumnFormat: public FrozenColumnFormat {
                                ssize_t previousBest,
                                std::shared_ptr<void> & cachedInfo) const override
     {
-        // Worst case is 8 bytes per timestamp for a double column
-        return sizeof(TimestampFrozenColumn) + 8 * (column.maxRowNumber - column.minRowNumber);
+        auto info = std::make_shared<TimestampFrozenColumn::SizingInfo>
+            (column, params);
+        ssize_t result = info->bytesRequired;
+        cachedInfo = info;
+        return result;
     }
     
     virtual FrozenColumn *
@@ -1495,13 +1888,16 @@ struct TimestampFrozenColumnFormat: public FrozenColumnFormat {
            const ColumnFreezeParameters & params,
            std::shared_ptr<void> cachedInfo) const override
     {
-        return new TimestampFrozenColumn(column, serializer, params);
+        auto infoCast
+            = std::static_pointer_cast<TimestampFrozenColumn::SizingInfo>
+            (std::move(cachedInfo));
+        return new TimestampFrozenColumn(column, *infoCast, serializer);
     }
 
     virtual FrozenColumn *
     reconstitute(StructuredReconstituter & reconstituter) const override
     {
-        throw AnnotatedException(600, "Tabular reconstitution not finished");
+        return new TimestampFrozenColumn(reconstituter);
     }
 };
 
@@ -1579,6 +1975,100 @@ FrozenColumn()
 {
 }
 
+void
+FrozenColumn::
+getRange(uint32_t begin, uint32_t end, CellValue * out) const
+{
+    ExcAssertLessEqual(begin, end);
+    for (uint32_t i = begin;  i < end;  ++i) {
+        *out++ = get(i);
+    }
+}
+
+void
+FrozenColumn::
+getSelection(const uint32_t * rows, size_t numRows, CellValue * out) const
+{
+    for (size_t i = 0;  i < numRows;  ++i) {
+        out[i] = get(rows[i]);
+    }
+}
+
+bool
+FrozenColumn::
+getRangeDouble(uint32_t begin, uint32_t end, double * out) const
+{
+    ExcAssertLessEqual(begin, end);
+    CellValue buf[DECODE_BLOCK_SIZE];
+    for (uint32_t b = begin;  b < end;  b += DECODE_BLOCK_SIZE) {
+        uint32_t e = std::min<uint64_t>(end, (uint64_t)b + DECODE_BLOCK_SIZE);
+        getRange(b, e, buf);
+        for (uint32_t i = 0;  i < e - b;  ++i) {
+            if (!cellToDouble(buf[i], *out++))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool
+FrozenColumn::
+getRangeInt64(uint32_t begin, uint32_t end, int64_t * out,
+              int64_t nullValue) const
+{
+    ExcAssertLessEqual(begin, end);
+    CellValue buf[DECODE_BLOCK_SIZE];
+    for (uint32_t b = begin;  b < end;  b += DECODE_BLOCK_SIZE) {
+        uint32_t e = std::min<uint64_t>(end, (uint64_t)b + DECODE_BLOCK_SIZE);
+        getRange(b, e, buf);
+        for (uint32_t i = 0;  i < e - b;  ++i) {
+            if (!cellToInt64(buf[i], *out++, nullValue))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool
+FrozenColumn::
+isNull(uint32_t rowIndex) const
+{
+    return get(rowIndex).empty();
+}
+
+void
+FrozenColumn::
+getPresence(uint32_t begin, uint32_t end, uint64_t * out) const
+{
+    ExcAssertLessEqual(begin, end);
+    std::fill(out, out + (end - begin + 63) / 64, 0);
+    CellValue buf[DECODE_BLOCK_SIZE];
+    for (uint32_t b = begin;  b < end;  b += DECODE_BLOCK_SIZE) {
+        uint32_t e = std::min<uint64_t>(end, (uint64_t)b + DECODE_BLOCK_SIZE);
+        getRange(b, e, buf);
+        for (uint32_t i = 0;  i < e - b;  ++i) {
+            if (!buf[i].empty())
+                out[(b - begin + i) / 64] |= 1ULL << ((b - begin + i) % 64);
+        }
+    }
+}
+
+size_t
+FrozenColumn::
+countNonNull(uint32_t begin, uint32_t end) const
+{
+    ExcAssertLessEqual(begin, end);
+    static constexpr size_t BLOCK_SIZE = DECODE_BLOCK_SIZE * 16;
+    uint64_t bits[BLOCK_SIZE / 64];
+    size_t result = 0;
+    for (uint32_t b = begin;  b < end;  b += BLOCK_SIZE) {
+        uint32_t e = std::min<uint64_t>(end, (uint64_t)b + BLOCK_SIZE);
+        getPresence(b, e, bits);
+        result += countBits(bits, e - b);
+    }
+    return result;
+}
+
 std::pair<ssize_t, std::function<std::shared_ptr<FrozenColumn>
                                  (TabularDatasetColumn & column,
                                   MappedSerializer & Serializer)> >
@@ -1694,6 +2184,97 @@ serializeMetadata(StructuredSerializer & serializer,
     serializeTo.freeze();
 }
 
+namespace {
+
+// Parse the md.json entry written by serializeMetadata(), calling onMember
+// with the parsing context positioned on the value of each member.
+template<typename Fn>
+void parseMetadata(StructuredReconstituter & reconstituter, Fn && onMember)
+{
+    FrozenMemoryRegion region = reconstituter.getRegion("md.json");
+    Utf8StringJsonParsingContext context(region.data(), region.length(),
+                                         "md.json");
+    context.forEachMember([&] () { onMember(context.fieldName(), context); });
+}
+
+} // file scope
+
+void
+FrozenColumn::
+reconstituteMetadata(StructuredReconstituter & reconstituter,
+                     void * md,
+                     const ValueDescription * desc)
+{
+    ExcAssert(desc);
+    bool foundData = false;
+
+    auto onMember = [&] (const std::string & field,
+                         JsonParsingContext & context)
+        {
+            if (field == "type") {
+                std::string type = context.expectStringAscii();
+                if (type != desc->typeName) {
+                    throw AnnotatedException
+                        (400, "Frozen column metadata has type " + type
+                         + " but " + desc->typeName + " was expected",
+                         "context", reconstituter.getContext());
+                }
+            }
+            else if (field == "ver") {
+                int version = context.expectInt();
+                if (version > desc->getVersion()) {
+                    throw AnnotatedException
+                        (400, "Frozen column metadata for " + desc->typeName
+                         + " has version " + std::to_string(version)
+                         + " which is newer than the supported version "
+                         + std::to_string(desc->getVersion()),
+                         "context", reconstituter.getContext());
+                }
+            }
+            else if (field == "data") {
+                desc->parseJson(md, context);
+                foundData = true;
+            }
+            else context.skip();
+        };
+
+    parseMetadata(reconstituter, onMember);
+
+    if (!foundData) {
+        throw AnnotatedException
+            (400, "Frozen column metadata has no data",
+             "context", reconstituter.getContext());
+    }
+}
+
+std::shared_ptr<FrozenColumn>
+FrozenColumn::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    std::string format;
+
+    auto onMember = [&] (const std::string & field,
+                         JsonParsingContext & context)
+        {
+            if (field == "fmt")
+                format = context.expectStringAscii();
+            else context.skip();
+        };
+    
+    parseMetadata(reconstituter, onMember);
+
+    auto formats = getFormats().load();
+    auto it = formats->find(format);
+    if (it == formats->end()) {
+        throw AnnotatedException
+            (400, "Unknown frozen column format '" + format + "'",
+             "context", reconstituter.getContext());
+    }
+
+    return std::shared_ptr<FrozenColumn>
+        (it->second->reconstitute(reconstituter));
+}
+
 
 } // namespace MLDB
 
@@ -25,6 +25,15 @@ struct ColumnFreezeParameters {
 };
 
 
+/** Intersect the rows [begin, end) with the numEntries rows from
+    firstEntry that are stored in a column.  The result is an empty range
+    within [begin, end) if they don't overlap.
+*/
+std::pair<uint32_t, uint32_t>
+clipRange(uint32_t begin, uint32_t end,
+          uint64_t firstEntry, uint64_t numEntries);
+
+
 /*****************************************************************************/
 /* FROZEN COLUMN                                                             */
 /*****************************************************************************/
@@ -41,6 +50,60 @@ struct FrozenColumn {
 
     virtual CellValue get(uint32_t rowIndex) const = 0;
 
+    /** Decode the values of rows [begin, end) into out, which must have
+        space for end - begin values.  Rows that aren't stored in the
+        column are null.
+
+        The default implementation calls get() for each row; formats
+        override it to decode a run of rows in a single pass.
+    */
+    virtual void getRange(uint32_t begin, uint32_t end, CellValue * out) const;
+
+    /** Decode the values of the given rows into out, which must have
+        space for numRows values.  The rows must be in ascending order.
+    */
+    virtual void getSelection(const uint32_t * rows, size_t numRows,
+                              CellValue * out) const;
+
+    /** Decode the values of rows [begin, end) as doubles into out.  Nulls
+        are written as NaN, and timestamps as seconds since the epoch.
+        Returns false if any other value in the range isn't a number, in
+        which case the contents of out are unspecified.
+    */
+    virtual bool getRangeDouble(uint32_t begin, uint32_t end,
+                                double * out) const;
+
+    /** Decode the values of rows [begin, end) as integers into out, with
+        nulls written as nullValue.  Returns false if any value in the
+        range isn't an integer that fits in 64 signed bits, in which case
+        the contents of out are unspecified.
+    */
+    virtual bool getRangeInt64(uint32_t begin, uint32_t end, int64_t * out,
+                               int64_t nullValue) const;
+
+    /** Is the given row null?  Rows that aren't stored in the column are.
+        The default implementation calls get().
+    */
+    virtual bool isNull(uint32_t rowIndex) const;
+
+    /** Set bit i of out (bit i % 64 of word i / 64) if row begin + i has a
+        value, and clear it otherwise.  Out must have space for
+        (end - begin + 63) / 64 words.  This allows IS NULL and IS NOT
+        NULL to be tested on many rows at once, and the presence of several
+        columns to be combined with bitwise operations.
+
+        The default implementation decodes the values with getRange();
+        formats that keep a FrozenPresenceBitmap override it to answer
+        without looking at the values.
+    */
+    virtual void getPresence(uint32_t begin, uint32_t end,
+                             uint64_t * out) const;
+
+    /** How many of the rows [begin, end) have a value?  The default
+        implementation counts the bits returned by getPresence().
+    */
+    virtual size_t countNonNull(uint32_t begin, uint32_t end) const;
+
     virtual size_t size() const = 0;
 
     virtual size_t memusage() const = 0;
@@ -66,6 +129,13 @@ struct FrozenColumn {
            MappedSerializer & serializer,
            const ColumnFreezeParameters & params);
 
+    /** Reconstitute a column that was written with serialize(), using
+        the format recorded in its metadata.  The column's storage is
+        mapped from the reconstituter, not copied.
+    */
+    static std::shared_ptr<FrozenColumn>
+    reconstitute(StructuredReconstituter & reconstituter);
+
     // Serialize the metadata.  Should be called first from serialize().
     void serializeMetadata(StructuredSerializer & serializer,
                            const void * md,
@@ -81,6 +151,22 @@ struct FrozenColumn {
         serializeMetadata(serializer, &md, desc.get());
     }
 
+    // Reconstitute the metadata written by serializeMetadata().  Should be
+    // called first from a reconstituting constructor.
+    static void reconstituteMetadata(StructuredReconstituter & reconstituter,
+                                     void * md,
+                                     const ValueDescription * desc);
+
+    template<typename T>
+    static void
+    reconstituteMetadataT(StructuredReconstituter & reconstituter,
+                          T & md,
+                          const std::shared_ptr<const ValueDescriptionT<T> > & desc
+                          = getDefaultDescriptionSharedT<T>())
+    {
+        reconstituteMetadata(reconstituter, &md, desc.get());
+    }
+
     virtual void serialize(StructuredSerializer & serializer) const = 0;
 };
 
@@ -12,6 +12,7 @@
 #include "mldb/ext/zstd/lib/dictBuilder/zdict.h"
 #include "mldb/ext/zstd/lib/zstd.h"
 #include "mldb/base/scope.h"
+#include "mldb/arch/simd_vector.h"
 #include <mutex>
 
 
@@ -62,6 +63,24 @@ get(size_t i) const
     return decode(i, val);
 }
 
+void
+FrozenIntegerTable::
+getRange(size_t begin, size_t end, uint64_t * out) const
+{
+    ExcAssertLessEqual(begin, end);
+    ExcAssertLessEqual(end, md.numEntries);
+    if (begin == end)
+        return;
+    // Unpack all of the entries at once, which is vectorized, then decode
+    // them in place
+    SIMD::vec_unpack_bits(storage.data(), storage.length(),
+                          begin * md.entryBits, md.entryBits, out,
+                          end - begin);
+    for (size_t i = begin;  i < end;  ++i, ++out) {
+        *out = decode(i, *out);
+    }
+}
+
 void
 FrozenIntegerTable::
 serialize(StructuredSerializer & serializer) const
@@ -70,6 +89,14 @@ serialize(StructuredSerializer & serializer) const
     serializer.addRegion(storage, "ints");
 }
 
+void
+FrozenIntegerTable::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    reconstituter.getObject("md.json", md);
+    storage = reconstituter.getRegionT<uint64_t>("ints");
+}
+
 
 /*****************************************************************************/
 /* MUTABLE INTEGER TABLE                                                     */
@@ -215,6 +242,400 @@ freeze(MappedSerializer & serializer)
 }
 
 
+/*****************************************************************************/
+/* PRESENCE BITMAP                                                           */
+/*****************************************************************************/
+
+void setBitRange(uint64_t * bits, size_t begin, size_t end)
+{
+    if (begin >= end)
+        return;
+    size_t firstWord = begin / 64, lastWord = (end - 1) / 64;
+    uint64_t firstMask = ~0ULL << (begin % 64);
+    uint64_t lastMask = ~0ULL >> (63 - (end - 1) % 64);
+    if (firstWord == lastWord) {
+        bits[firstWord] |= firstMask & lastMask;
+        return;
+    }
+    bits[firstWord] |= firstMask;
+    for (size_t i = firstWord + 1;  i < lastWord;  ++i)
+        bits[i] = ~0ULL;
+    bits[lastWord] |= lastMask;
+}
+
+size_t countBits(const uint64_t * bits, size_t numBits)
+{
+    size_t result = 0;
+    for (size_t i = 0;  i < numBits / 64;  ++i)
+        result += __builtin_popcountll(bits[i]);
+    if (numBits % 64)
+        result += __builtin_popcountll(bits[numBits / 64]
+                                       & ((1ULL << (numBits % 64)) - 1));
+    return result;
+}
+
+namespace {
+
+// Read numBits (at most 64) bits starting at bitPos
+uint64_t readBits(const uint64_t * words, size_t bitPos, int numBits)
+{
+    size_t word = bitPos / 64;
+    int shift = bitPos % 64;
+    uint64_t result = words[word] >> shift;
+    if (shift != 0 && shift + numBits > 64)
+        result |= words[word + 1] << (64 - shift);
+    if (numBits < 64)
+        result &= (1ULL << numBits) - 1;
+    return result;
+}
+
+// Or numBits (at most 64) bits into out starting at bitPos
+void orBits(uint64_t * out, size_t bitPos, uint64_t bits, int numBits)
+{
+    size_t word = bitPos / 64;
+    int shift = bitPos % 64;
+    out[word] |= bits << shift;
+    if (shift != 0 && shift + numBits > 64)
+        out[word + 1] |= bits >> (64 - shift);
+}
+
+// Find the first container with a key of at least the given one
+const PresenceBitmapContainer *
+findContainer(const FrozenMemoryRegionT<PresenceBitmapContainer> & containers,
+              uint32_t key)
+{
+    const PresenceBitmapContainer * begin = containers.data();
+    const PresenceBitmapContainer * end = begin + containers.length();
+    return std::lower_bound(begin, end, key,
+                            [] (const PresenceBitmapContainer & c,
+                                uint32_t key)
+                            {
+                                return c.key < key;
+                            });
+}
+
+} // file scope
+
+IMPLEMENT_STRUCTURE_DESCRIPTION(FrozenPresenceBitmapMetadata)
+{
+    setVersion(1);
+    addAuto("numSet", &FrozenPresenceBitmapMetadata::numSet, "");
+}
+
+size_t
+FrozenPresenceBitmap::
+memusage() const
+{
+    return containers.memusage() + data.memusage();
+}
+
+bool
+FrozenPresenceBitmap::
+test(uint32_t row) const
+{
+    uint32_t key = row >> CONTAINER_BITS;
+    const PresenceBitmapContainer * c = findContainer(containers, key);
+    if (c == containers.data() + containers.length() || c->key != key)
+        return false;
+
+    uint32_t low = row & ((1U << CONTAINER_BITS) - 1);
+    const uint64_t * words = data.data() + c->offset;
+    const uint16_t * vals = reinterpret_cast<const uint16_t *>(words);
+
+    switch (c->type) {
+    case ARRAY:
+        return std::binary_search(vals, vals + c->size, low);
+    case BITMAP:
+        return low / 64 < c->size && ((words[low / 64] >> (low % 64)) & 1);
+    case RUNS: {
+        // Find the last run starting at or before the row
+        size_t lo = 0, hi = c->size;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (vals[mid * 2] <= low)
+                lo = mid + 1;
+            else hi = mid;
+        }
+        return lo > 0 && low <= vals[(lo - 1) * 2] + vals[(lo - 1) * 2 + 1];
+    }
+    }
+
+    throw AnnotatedException(500, "Unknown presence bitmap container type");
+}
+
+size_t
+FrozenPresenceBitmap::
+rank(uint32_t row) const
+{
+    uint32_t key = row >> CONTAINER_BITS;
+    const PresenceBitmapContainer * c = findContainer(containers, key);
+    if (c == containers.data() + containers.length())
+        return md.numSet;
+    if (c->key != key)
+        return c->rank;
+
+    uint32_t low = row & ((1U << CONTAINER_BITS) - 1);
+    const uint64_t * words = data.data() + c->offset;
+    const uint16_t * vals = reinterpret_cast<const uint16_t *>(words);
+
+    switch (c->type) {
+    case ARRAY:
+        return c->rank + (std::lower_bound(vals, vals + c->size, low) - vals);
+    case BITMAP:
+        return c->rank
+            + countBits(words, std::min<size_t>(low, c->size * 64));
+    case RUNS: {
+        size_t result = c->rank;
+        for (size_t i = 0;  i < c->size && vals[i * 2] < low;  ++i) {
+            result += std::min<size_t>(vals[i * 2 + 1] + 1,
+                                       low - vals[i * 2]);
+        }
+        return result;
+    }
+    }
+
+    throw AnnotatedException(500, "Unknown presence bitmap container type");
+}
+
+void
+FrozenPresenceBitmap::
+getBits(uint32_t begin, uint32_t end, uint64_t * out,
+        size_t outOffset) const
+{
+    if (begin >= end)
+        return;
+
+    const PresenceBitmapContainer * c
+        = findContainer(containers, begin >> CONTAINER_BITS);
+    const PresenceBitmapContainer * last
+        = containers.data() + containers.length();
+
+    for (;  c != last && (uint64_t(c->key) << CONTAINER_BITS) < end;  ++c) {
+        uint64_t base = uint64_t(c->key) << CONTAINER_BITS;
+        uint32_t lo = std::max<uint64_t>(begin, base) - base;
+        uint32_t hi = std::min<uint64_t>(end, base + (1U << CONTAINER_BITS))
+            - base;
+        size_t outBase = outOffset + base - begin;
+
+        const uint64_t * words = data.data() + c->offset;
+        const uint16_t * vals = reinterpret_cast<const uint16_t *>(words);
+
+        switch (c->type) {
+        case ARRAY:
+            for (const uint16_t * v = std::lower_bound(vals, vals + c->size, lo);
+                 v != vals + c->size && *v < hi;  ++v) {
+                size_t bit = outBase + *v;
+                out[bit / 64] |= 1ULL << (bit % 64);
+            }
+            break;
+        case BITMAP:
+            hi = std::min<uint32_t>(hi, c->size * 64);
+            for (uint32_t r = lo;  r < hi;  r += 64) {
+                int numBits = std::min<uint32_t>(64, hi - r);
+                orBits(out, outBase + r, readBits(words, r, numBits), numBits);
+            }
+            break;
+        case RUNS:
+            for (size_t i = 0;  i < c->size;  ++i) {
+                uint32_t start = vals[i * 2];
+                uint32_t runEnd = start + vals[i * 2 + 1] + 1;
+                if (runEnd <= lo)
+                    continue;
+                if (start >= hi)
+                    break;
+                setBitRange(out, outBase + std::max(start, lo),
+                            outBase + std::min(runEnd, hi));
+            }
+            break;
+        }
+    }
+}
+
+void
+FrozenPresenceBitmap::
+serialize(StructuredSerializer & serializer) const
+{
+    serializer.newObject("md.json", md);
+    serializer.addRegion(containers, "containers");
+    serializer.addRegion(data, "data");
+}
+
+void
+FrozenPresenceBitmap::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    reconstituter.getObject("md.json", md);
+    containers
+        = reconstituter.getRegionT<PresenceBitmapContainer>("containers");
+    data = reconstituter.getRegionT<uint64_t>("data");
+}
+
+
+/*****************************************************************************/
+/* MUTABLE PRESENCE BITMAP                                                   */
+/*****************************************************************************/
+
+namespace {
+
+// Work out how to store the rows of each container, calling
+// onContainer(begin, end, type, size, words) for the range of rows in
+// each one.
+template<typename Fn>
+void forEachPresenceContainer(const std::vector<uint32_t> & rows,
+                              Fn && onContainer)
+{
+    static constexpr int BITS = FrozenPresenceBitmap::CONTAINER_BITS;
+
+    for (size_t begin = 0, end;  begin < rows.size();  begin = end) {
+        uint32_t key = rows[begin] >> BITS;
+        size_t numRuns = 0;
+        for (end = begin;  end < rows.size() && (rows[end] >> BITS) == key;
+             ++end) {
+            numRuns += end == begin || rows[end] != rows[end - 1] + 1;
+        }
+
+        uint32_t maxLow = rows[end - 1] & ((1U << BITS) - 1);
+        size_t arrayWords = (end - begin + 3) / 4;
+        size_t bitmapWords = maxLow / 64 + 1;
+        size_t runWords = (numRuns + 1) / 2;
+
+        if (runWords <= arrayWords && runWords <= bitmapWords)
+            onContainer(begin, end, FrozenPresenceBitmap::RUNS,
+                        numRuns, runWords);
+        else if (arrayWords <= bitmapWords)
+            onContainer(begin, end, FrozenPresenceBitmap::ARRAY,
+                        end - begin, arrayWords);
+        else onContainer(begin, end, FrozenPresenceBitmap::BITMAP,
+                         bitmapWords, bitmapWords);
+    }
+}
+
+} // file scope
+
+void
+MutablePresenceBitmap::
+set(uint32_t row)
+{
+    ExcAssert(rows.empty() || row > rows.back());
+    rows.push_back(row);
+}
+
+size_t
+MutablePresenceBitmap::
+bytesRequired() const
+{
+    size_t result = 0;
+    forEachPresenceContainer(rows, [&] (size_t, size_t, int, size_t,
+                                        size_t words)
+                             {
+                                 result += sizeof(PresenceBitmapContainer)
+                                     + words * 8;
+                             });
+    return result;
+}
+
+FrozenPresenceBitmap
+MutablePresenceBitmap::
+freeze(MappedSerializer & serializer) const
+{
+    static constexpr int BITS = FrozenPresenceBitmap::CONTAINER_BITS;
+
+    size_t numContainers = 0, numWords = 0;
+    forEachPresenceContainer(rows, [&] (size_t, size_t, int, size_t,
+                                        size_t words)
+                             {
+                                 ++numContainers;
+                                 numWords += words;
+                             });
+
+    auto containers = serializer
+        .allocateWritableT<PresenceBitmapContainer>(numContainers);
+    auto data = serializer.allocateWritableT<uint64_t>(numWords);
+    std::fill(data.data(), data.data() + data.length(), 0);
+
+    size_t n = 0, offset = 0;
+    auto onContainer = [&] (size_t begin, size_t end, int type,
+                            size_t size, size_t words)
+        {
+            PresenceBitmapContainer & c = containers.data()[n++];
+            c = PresenceBitmapContainer();
+            c.key = rows[begin] >> BITS;
+            c.type = type;
+            c.size = size;
+            c.offset = offset;
+            c.rank = begin;
+            c.count = end - begin;
+
+            uint64_t * out = data.data() + offset;
+            uint16_t * vals = reinterpret_cast<uint16_t *>(out);
+            size_t numRuns = 0;
+            for (size_t i = begin;  i < end;  ++i) {
+                uint16_t low = rows[i] & ((1U << BITS) - 1);
+                switch (type) {
+                case FrozenPresenceBitmap::ARRAY:
+                    vals[i - begin] = low;
+                    break;
+                case FrozenPresenceBitmap::BITMAP:
+                    out[low / 64] |= 1ULL << (low % 64);
+                    break;
+                case FrozenPresenceBitmap::RUNS:
+                    if (i == begin || rows[i] != rows[i - 1] + 1) {
+                        vals[numRuns * 2] = low;
+                        vals[numRuns * 2 + 1] = 0;
+                        ++numRuns;
+                    }
+                    else ++vals[numRuns * 2 - 1];
+                    break;
+                }
+            }
+
+            offset += words;
+        };
+
+    forEachPresenceContainer(rows, onContainer);
+
+    FrozenPresenceBitmap result;
+    result.md.numSet = rows.size();
+    result.containers = containers.freeze();
+    result.data = data.freeze();
+    return result;
+}
+
+bool presenceIsNull(const FrozenPresenceBitmap * presence,
+                    uint64_t firstEntry, uint64_t numEntries,
+                    uint32_t rowIndex)
+{
+    if (rowIndex < firstEntry || rowIndex - firstEntry >= numEntries)
+        return true;
+    return presence && !presence->test(rowIndex - firstEntry);
+}
+
+void presenceGetBits(const FrozenPresenceBitmap * presence,
+                     uint64_t firstEntry, uint64_t numEntries,
+                     uint32_t begin, uint32_t end, uint64_t * out)
+{
+    ExcAssertLessEqual(begin, end);
+    std::fill(out, out + (end - begin + 63) / 64, 0);
+    uint32_t first, last;
+    std::tie(first, last) = clipRange(begin, end, firstEntry, numEntries);
+    if (presence)
+        presence->getBits(first - firstEntry, last - firstEntry, out,
+                          first - begin);
+    else setBitRange(out, first - begin, last - begin);
+}
+
+size_t presenceCount(const FrozenPresenceBitmap * presence,
+                     uint64_t firstEntry, uint64_t numEntries,
+                     uint32_t begin, uint32_t end)
+{
+    uint32_t first, last;
+    std::tie(first, last) = clipRange(begin, end, firstEntry, numEntries);
+    if (presence)
+        return presence->countRange(first - firstEntry, last - firstEntry);
+    return last - first;
+}
+
+
 /*****************************************************************************/
 /* FROZEN BLOB TABLE                                                         */
 /*****************************************************************************/
@@ -400,6 +821,18 @@ serialize(StructuredSerializer & serializer) const
     offset.serialize(*serializer.newStructure("offsets"));
 }
 
+void
+FrozenBlobTable::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    reconstituter.getObject("md.json", md);
+    formatData = reconstituter.getRegion("fmt");
+    blobData = reconstituter.getRegion("blob");
+    offset.reconstitute(*reconstituter.getStructure("offsets"));
+    // Any dictionary cached from the previous contents is now stale
+    itl.reset(new Itl());
+}
+
 
 /*****************************************************************************/
 /* MUTABLE BLOB TABLE                                                        */
@@ -654,6 +1087,13 @@ serialize(StructuredSerializer & serializer) const
     blobs.serialize(serializer);
 }
 
+void
+FrozenCellValueTable::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    blobs.reconstitute(reconstituter);
+}
+
 
 /*****************************************************************************/
 /* MUTABLE CELL VALUE TABLE                                                  */
@@ -698,6 +1138,98 @@ freeze(MappedSerializer & serializer)
 }
 
 
+/*****************************************************************************/
+/* FROZEN CELL VALUE SET                                                     */
+/*****************************************************************************/
+
+FrozenCellValueSet::
+FrozenCellValueSet(FrozenCellValueSet && other)
+    : offsets(std::move(other.offsets)),
+      cells(std::move(other.cells)),
+      decoded(std::move(other.decoded)),
+      decodedBytes(other.decodedBytes.exchange(0))
+{
+}
+
+FrozenCellValueSet &
+FrozenCellValueSet::
+operator = (FrozenCellValueSet && other)
+{
+    if (this == &other)
+        return *this;
+    // Our decoded values are sized by our own offsets, so they need to be
+    // freed before those are replaced
+    freeDecoded();
+    offsets = std::move(other.offsets);
+    cells = std::move(other.cells);
+    decoded = std::move(other.decoded);
+    decodedBytes = other.decodedBytes.exchange(0);
+    return *this;
+}
+
+FrozenCellValueSet::
+~FrozenCellValueSet()
+{
+    freeDecoded();
+}
+
+void
+FrozenCellValueSet::
+freeDecoded()
+{
+    if (!decoded)
+        return;
+    for (size_t i = 0;  i < size();  ++i)
+        delete decoded[i].load(std::memory_order_relaxed);
+    decoded.reset();
+    decodedBytes = 0;
+}
+
+void
+FrozenCellValueSet::
+initDecoded()
+{
+    decoded.reset(new std::atomic<const CellValue *>[size()]);
+    for (size_t i = 0;  i < size();  ++i)
+        decoded[i].store(nullptr, std::memory_order_relaxed);
+}
+
+CellValue
+FrozenCellValueSet::
+decodeShared(size_t index) const
+{
+    CellValue result = decode(index);
+
+    // Values held inline in the CellValue are as cheap to decode as to
+    // copy, so only those with a payload on the heap are kept
+    size_t bytes = result.memusage();
+    if (bytes <= sizeof(CellValue))
+        return result;
+
+    // Check before reserving, so that once the cache is full lookups
+    // don't keep writing to the shared counter
+    if (decodedBytes.load(std::memory_order_relaxed) + bytes
+        > MAX_DECODED_BYTES)
+        return result;
+    if (decodedBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes
+        > MAX_DECODED_BYTES) {
+        decodedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+        return result;
+    }
+
+    std::unique_ptr<CellValue> val(new CellValue(result));
+    const CellValue * expected = nullptr;
+    if (decoded[index].compare_exchange_strong(expected, val.get(),
+                                               std::memory_order_acq_rel)) {
+        val.release();
+        return result;
+    }
+    // Another thread got there first; use theirs
+    decodedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    return *expected;
+}
+
+
 /*****************************************************************************/
 /* MUTABLE CELL VALUE SET                                                    */
 /*****************************************************************************/
@@ -741,6 +1273,7 @@ freeze(MappedSerializer & serializer)
     FrozenCellValueSet result;
     result.offsets = std::move(frozenOffsets);
     result.cells = region.freeze();
+    result.initDecoded();
     return std::make_pair(std::move(result), std::move(remapping));
 }
 
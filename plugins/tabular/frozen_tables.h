@@ -13,6 +13,8 @@
 #include "mldb/arch/bit_range_ops.h"
 #include "mldb/arch/endian.h"
 #include "mldb/sql/cell_value.h"
+#include <memory>
+#include <atomic>
 
 namespace MLDB {
 
@@ -90,7 +92,17 @@ struct FrozenIntegerTable {
 
     uint64_t get(size_t i) const;
 
+    /** Decode entries [begin, end) into out.  This extracts the entries
+        sequentially, which is much cheaper than calling get() for each.
+    */
+    void getRange(size_t begin, size_t end, uint64_t * out) const;
+
     void serialize(StructuredSerializer & serializer) const;
+
+    /** Reconstitute from what serialize() wrote.  The storage is mapped,
+        not copied.
+    */
+    void reconstitute(StructuredReconstituter & reconstituter);
 };
 
 struct MutableIntegerTable {
@@ -111,6 +123,162 @@ struct MutableIntegerTable {
 };
 
 
+/*****************************************************************************/
+/* PRESENCE BITMAP                                                           */
+/*****************************************************************************/
+
+/** Set bits [begin, end) of the bit array, where bit i is bit i % 64 of
+    word i / 64.
+*/
+void setBitRange(uint64_t * bits, size_t begin, size_t end);
+
+/** Count the set bits among the first numBits bits of the bit array. */
+size_t countBits(const uint64_t * bits, size_t numBits);
+
+/** One container of a presence bitmap, covering 65536 rows. */
+struct PresenceBitmapContainer {
+    uint32_t key = 0;      ///< Rows from key * 65536 are covered
+    uint32_t type = 0;     ///< How the rows are stored
+    uint32_t size = 0;     ///< Number of values, words or runs stored
+    uint32_t offset = 0;   ///< Offset of the stored data in words
+    uint32_t rank = 0;     ///< Number of rows set in previous containers
+    uint32_t count = 0;    ///< Number of rows set in this container
+};
+
+struct FrozenPresenceBitmapMetadata {
+    uint64_t numSet = 0;
+};
+
+/** Compressed bitmap of the rows of a column that have a value, which
+    allows formats to store nulls without reserving a value for them.
+
+    This is organized like a roaring bitmap: the rows are split into
+    containers of 65536 rows, each of which is stored as whichever is
+    smallest of a sorted array of its rows, a bitmap (truncated after the
+    last row set) or a list of runs.  Those that have no rows set aren't
+    stored.
+*/
+struct FrozenPresenceBitmap {
+    enum ContainerType {
+        ARRAY = 0,   ///< Sorted 16 bit row offsets, four per word
+        BITMAP = 1,  ///< One bit per row
+        RUNS = 2     ///< (start, length - 1) pairs of 16 bit row offsets
+    };
+
+    static constexpr int CONTAINER_BITS = 16;
+
+    FrozenPresenceBitmapMetadata md;
+    FrozenMemoryRegionT<PresenceBitmapContainer> containers;
+    FrozenMemoryRegionT<uint64_t> data;
+
+    size_t memusage() const;
+
+    /// Number of rows that are set
+    size_t count() const
+    {
+        return md.numSet;
+    }
+
+    /// Is the given row set?
+    bool test(uint32_t row) const;
+
+    /// Number of rows less than the given row that are set
+    size_t rank(uint32_t row) const;
+
+    /// Number of rows in [begin, end) that are set
+    size_t countRange(uint32_t begin, uint32_t end) const
+    {
+        return rank(end) - rank(begin);
+    }
+
+    /** Or the bits for rows [begin, end) into out, with row begin going
+        to bit outOffset.  Combined with the same call on other bitmaps,
+        this gives the union, or with a temporary the intersection, of
+        the presence of several columns.
+    */
+    void getBits(uint32_t begin, uint32_t end, uint64_t * out,
+                 size_t outOffset = 0) const;
+
+    /// Call onRow for each row that is set, in order
+    template<typename Fn>
+    bool forEach(Fn && onRow) const
+    {
+        for (size_t i = 0;  i < containers.length();  ++i) {
+            const PresenceBitmapContainer & c = containers[i];
+            uint32_t base = c.key << CONTAINER_BITS;
+            const uint64_t * words = data.data() + c.offset;
+            const uint16_t * vals = reinterpret_cast<const uint16_t *>(words);
+
+            switch (c.type) {
+            case ARRAY:
+                for (size_t j = 0;  j < c.size;  ++j)
+                    if (!onRow(base + vals[j]))
+                        return false;
+                break;
+            case BITMAP:
+                for (size_t j = 0;  j < c.size;  ++j) {
+                    for (uint64_t w = words[j];  w;  w &= w - 1) {
+                        if (!onRow(base + j * 64 + __builtin_ctzll(w)))
+                            return false;
+                    }
+                }
+                break;
+            case RUNS:
+                for (size_t j = 0;  j < c.size;  ++j) {
+                    uint32_t start = base + vals[j * 2];
+                    uint32_t end = start + vals[j * 2 + 1] + 1;
+                    for (uint32_t r = start;  r < end;  ++r)
+                        if (!onRow(r))
+                            return false;
+                }
+                break;
+            }
+        }
+        return true;
+    }
+
+    void serialize(StructuredSerializer & serializer) const;
+
+    /** Reconstitute from what serialize() wrote.  The storage is mapped,
+        not copied.
+    */
+    void reconstitute(StructuredReconstituter & reconstituter);
+};
+
+struct MutablePresenceBitmap {
+    /// Set the given row.  Rows must be set in increasing order.
+    void set(uint32_t row);
+
+    size_t count() const
+    {
+        return rows.size();
+    }
+
+    size_t bytesRequired() const;
+
+    FrozenPresenceBitmap freeze(MappedSerializer & serializer) const;
+
+    std::vector<uint32_t> rows;
+};
+
+/** Helpers to implement FrozenColumn::isNull(), getPresence() and
+    countNonNull() for a format that stores numEntries rows from
+    firstEntry.  The presence bitmap has the rows that have a value,
+    numbered from firstEntry; if it's null then they all have one.
+*/
+bool presenceIsNull(const FrozenPresenceBitmap * presence,
+                    uint64_t firstEntry, uint64_t numEntries,
+                    uint32_t rowIndex);
+
+void presenceGetBits(const FrozenPresenceBitmap * presence,
+                     uint64_t firstEntry, uint64_t numEntries,
+                     uint32_t begin, uint32_t end, uint64_t * out);
+
+size_t presenceCount(const FrozenPresenceBitmap * presence,
+                     uint64_t firstEntry, uint64_t numEntries,
+                     uint32_t begin, uint32_t end);
+
+
 /*****************************************************************************/
 /* DOUBLE TABLE                                                              */
 /*****************************************************************************/
@@ -206,6 +374,7 @@ struct FrozenBlobTable {
     size_t memusage() const;
     size_t size() const;
     void serialize(StructuredSerializer & serializer) const;
+    void reconstitute(StructuredReconstituter & reconstituter);
 
     struct Itl;
     std::shared_ptr<Itl> itl;
@@ -315,6 +484,7 @@ struct FrozenCellValueTable {
     }
 
     void serialize(StructuredSerializer & serializer) const;
+    void reconstitute(StructuredReconstituter & reconstituter);
 
     FrozenBlobTable blobs;
 };
@@ -352,7 +522,33 @@ struct MutableCellValueTable {
 
 struct FrozenCellValueSet {
 
+    FrozenCellValueSet() = default;
+    FrozenCellValueSet(FrozenCellValueSet && other);
+    FrozenCellValueSet & operator = (FrozenCellValueSet && other);
+    ~FrozenCellValueSet();
+
+    /** Return the value at the given index.
+
+        Values whose decoding allocates (long strings, blobs and paths)
+        are kept once decoded, so that after that a lookup is a copy that
+        shares the kept value's payload rather than allocating a new one.
+        This duplicates those entries of the dictionary on the heap: it
+        costs a pointer per entry, plus the size of each kept value, up to
+        MAX_DECODED_BYTES per set.  Past that, and for all other values,
+        each lookup decodes the value again.
+    */
     CellValue operator [] (size_t index) const
+    {
+        if (!decoded)
+            return decode(index);
+        const CellValue * val = decoded[index].load(std::memory_order_acquire);
+        if (MLDB_LIKELY(val != nullptr))
+            return *val;
+        return decodeShared(index);
+    }
+
+    /** Decode the value at the given index from its serialized form. */
+    CellValue decode(size_t index) const
     {
         static uint8_t format
             = CellValue::serializationFormat(true /* known length */);
@@ -366,7 +562,11 @@ struct FrozenCellValueSet {
 
     uint64_t memusage() const
     {
-        return offsets.memusage() + cells.memusage() + sizeof(*this);
+        uint64_t result = offsets.memusage() + cells.memusage() + sizeof(*this);
+        if (decoded)
+            result += size() * sizeof(decoded[0])
+                + decodedBytes.load(std::memory_order_relaxed);
+        return result;
     }
 
     size_t size() const
@@ -398,8 +598,35 @@ struct FrozenCellValueSet {
         serializer.addRegion(cells, "cells");
     }
 
+    void reconstitute(StructuredReconstituter & reconstituter)
+    {
+        offsets.reconstitute(reconstituter);
+        cells = reconstituter.getRegion("cells");
+        initDecoded();
+    }
+
+    /** Set up the (empty) per-value cache used by operator []. */
+    void initDecoded();
+
+    /** Decode the value at index, keeping it in the cache if it's worth
+        it and there is room.  Safe to call from multiple threads at once.
+    */
+    CellValue decodeShared(size_t index) const;
+
+    /** Free the values in the cache, and the cache itself. */
+    void freeDecoded();
+
+    /// Maximum number of bytes of decoded values kept by a single set
+    static constexpr size_t MAX_DECODED_BYTES = 4 * 1024 * 1024;
+
     FrozenIntegerTable offsets;
     FrozenMemoryRegion cells;
+
+    /// Values that have already been decoded, or null if not (yet) kept
+    std::unique_ptr<std::atomic<const CellValue *>[]> decoded;
+
+    /// Memory used by the values in decoded
+    mutable std::atomic<size_t> decodedBytes{0};
 };
 
 struct MutableCellValueSet {
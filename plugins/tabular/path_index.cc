@@ -0,0 +1,818 @@
+/** path_index.cc                                                  -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Implementation of the tabular dataset's row name index.
+*/
+
+#include "path_index.h"
+#include "mldb/arch/bitops.h"
+#include "mldb/arch/bit_range_ops.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include <atomic>
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+// Bits of filter per entry in the bloom filter.  With 8 bits set per
+// entry in a 256 bit block, this gives a false positive rate of well
+// under 1%.
+static constexpr size_t BLOOM_BITS_PER_ENTRY = 16;
+static constexpr size_t BLOOM_WORDS_PER_BLOCK = 8;
+
+// Odd constants used to pick one bit in each word of a bloom filter
+// block, as in the split block bloom filter of Putze et al.
+static constexpr uint32_t BLOOM_SALT[BLOOM_WORDS_PER_BLOCK] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+static constexpr uint64_t BLOOM_SEED = 0x6a09e667f3bcc909ULL;
+
+// Average number of entries in each bucket of the perfect hash.  Smaller
+// values build faster but need more memory for the pilots.
+static constexpr size_t PERFECT_HASH_ENTRIES_PER_BUCKET = 3;
+
+// A bucket whose entries can't be placed with a pilot below this causes
+// the build to be retried with another seed.
+static constexpr uint32_t PERFECT_HASH_MAX_PILOT = 1 << 16;
+static constexpr int PERFECT_HASH_MAX_SEEDS = 4;
+
+// Bits of each hash that are stored with its entry in the perfect hash,
+// so that lookups of most hashes that aren't there return nothing.
+static constexpr int FINGERPRINT_BITS = 8;
+
+// Finalizer of MurmurHash3, which makes each bit of the result depend on
+// every bit of the input.  The row hashes are good already, but the
+// shards are selected on some of their bits and so we need to remix
+// them to get independent values.
+uint64_t mixHash(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Turn a hash into a number in [0, n) without a division
+uint64_t scaleHash(uint64_t h, uint64_t n)
+{
+    return ((unsigned __int128)h * n) >> 64;
+}
+
+uint64_t perfectHashPosition(uint64_t mixed, uint32_t pilot,
+                             uint64_t tableSize)
+{
+    return scaleHash(mixHash(mixed ^ (pilot * 0x9e3779b97f4a7c15ULL)),
+                     tableSize);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* MUTABLE PATH INDEX                                                        */
+/*****************************************************************************/
+
+void
+MutablePathIndex::
+add(uint32_t firstChunkNumber,
+    const std::vector<const ChunkEntries *> & chunks)
+{
+    if (chunks.empty())
+        return;
+
+    for (auto & c: chunks) {
+        maxChunkIndex = std::max(maxChunkIndex, c->maxChunkIndex);
+        for (auto & e: c->toInsert)
+            numRows += e.size();
+    }
+    minChunkNumber = std::min(minChunkNumber, firstChunkNumber);
+    maxChunkNumber = std::max<uint32_t>(maxChunkNumber,
+                                        firstChunkNumber + chunks.size() - 1);
+
+    auto onShard = [&] (int shardNumber)
+        {
+            auto & entries = index[shardNumber];
+            size_t numBefore = entries.size();
+            for (size_t i = 0;  i < chunks.size();  ++i) {
+                for (auto & e: chunks[i]->toInsert[shardNumber]) {
+                    entries.emplace_back(e.first, firstChunkNumber + i,
+                                         e.second);
+                }
+            }
+            std::sort(entries.begin() + numBefore, entries.end());
+            std::inplace_merge(entries.begin(), entries.begin() + numBefore,
+                               entries.end());
+        };
+
+    parallelMap(0, INDEX_SHARDS, onShard);
+}
+
+std::pair<PathIndexLayer, std::vector<std::tuple<int, int, int, int> > >
+MutablePathIndex::
+freeze(MappedSerializer & serializer,
+       const PathIndexParameters & params) const
+{
+    PathIndexLayer result;
+    if (numRows != 0) {
+        result.firstChunk = minChunkNumber;
+        result.numChunks = maxChunkNumber - minChunkNumber + 1;
+        result.numRows = numRows;
+    }
+
+    std::vector<std::tuple<int, int, int, int> >
+        possibleCollisions[INDEX_SHARDS];
+    std::atomic<size_t> totalPossibleCollisions(0);
+
+    // Index each shard in parallel
+    auto onShard = [&] (int shardNumber)
+        {
+            possibleCollisions[shardNumber]
+            = result.shards[shardNumber]
+            .init(serializer,
+                  index[shardNumber],
+                  maxChunkNumber + 1, maxChunkIndex + 1,
+                  params);
+            totalPossibleCollisions += possibleCollisions[shardNumber].size();
+        };
+
+    parallelMap(0, INDEX_SHARDS, onShard);
+
+    std::vector<std::tuple<int, int, int, int> > collisions;
+    collisions.reserve(totalPossibleCollisions);
+    for (auto & c: possibleCollisions) {
+        collisions.insert(collisions.end(), c.begin(), c.end());
+    }
+
+    return std::make_pair(result, collisions);
+}
+
+
+/*****************************************************************************/
+/* PATH INDEX SHARD                                                          */
+/*****************************************************************************/
+
+IMPLEMENT_STRUCTURE_DESCRIPTION(PathIndexMetadata)
+{
+    setVersion(1);
+    addField("chunkBits", &PathIndexMetadata::chunkBits, "");
+    addField("offsetBits", &PathIndexMetadata::offsetBits, "");
+    addField("numEntries", &PathIndexMetadata::numEntries, "");
+    addField("factor", &PathIndexMetadata::factor, "");
+    addField("bloomBlocks", &PathIndexMetadata::bloomBlocks, "", (uint64_t)0);
+    addField("perfectHash", &PathIndexMetadata::perfectHash, "", false);
+    addField("numBuckets", &PathIndexMetadata::numBuckets, "", (uint64_t)0);
+    addField("tableSize", &PathIndexMetadata::tableSize, "", (uint64_t)0);
+    addField("pilotBits", &PathIndexMetadata::pilotBits, "", (uint8_t)0);
+    addField("seed", &PathIndexMetadata::seed, "", (uint64_t)0);
+}
+
+std::vector<std::tuple<int, int, int, int> >
+PathIndexShard::
+init(MappedSerializer & serializer,
+     const std::vector<std::tuple<uint64_t, int, int> > & input,
+     size_t numChunks,
+     size_t maxChunkSize,
+     const PathIndexParameters & params)
+{
+    // The input must be sorted by hash, so equal hashes are adjacent
+    std::vector<std::tuple<int, int, int, int> > possibleCollisions;
+
+    for (size_t idx = 1;  idx < input.size();  ++idx) {
+        if (std::get<0>(input[idx - 1]) == std::get<0>(input[idx])) {
+            possibleCollisions.emplace_back
+                (std::get<1>(input[idx - 1]), std::get<2>(input[idx - 1]),
+                 std::get<1>(input[idx]), std::get<2>(input[idx]));
+        }
+    }
+
+    chunkBits = MLDB::highest_bit(numChunks, -1) + 1;
+    offsetBits = MLDB::highest_bit(maxChunkSize - 1, -1) + 1;
+
+    if (params.bloomFilter && !input.empty())
+        initBloom(serializer, input);
+
+    // A perfect hash can't separate equal hashes, so shards that contain
+    // any use open addressing.
+    if (!params.perfectHash || !possibleCollisions.empty()
+        || !initPerfectHash(serializer, input))
+        initOpenAddressing(serializer, input);
+
+    return possibleCollisions;
+}
+
+void
+PathIndexShard::
+initBloom(MappedSerializer & serializer,
+          const std::vector<std::tuple<uint64_t, int, int> > & input)
+{
+    bloomBlocks = (input.size() * BLOOM_BITS_PER_ENTRY + 255) / 256;
+
+    auto words = serializer.allocateWritableT<uint32_t>
+        (bloomBlocks * BLOOM_WORDS_PER_BLOCK);
+    std::fill(words.data(), words.data() + words.length(), 0);
+
+    for (auto & i: input) {
+        uint64_t h = mixHash(std::get<0>(i) ^ BLOOM_SEED);
+        uint32_t * block
+            = words.data() + scaleHash(h, bloomBlocks) * BLOOM_WORDS_PER_BLOCK;
+        for (size_t j = 0;  j < BLOOM_WORDS_PER_BLOCK;  ++j) {
+            block[j] |= 1U << (((uint32_t)h * BLOOM_SALT[j]) >> 27);
+        }
+    }
+
+    bloom = words.freeze();
+}
+
+bool
+PathIndexShard::
+initPerfectHash(MappedSerializer & serializer,
+                const std::vector<std::tuple<uint64_t, int, int> > & input)
+{
+    // This is a minimal perfect hash built with hash and displace, as in
+    // PTHash (Pibiri and Trani, 2021).  Each hash is put in a bucket, and
+    // each bucket has a pilot value which is mixed with the hash to get
+    // its position in a table that is slightly larger than the number of
+    // entries.  The pilots are chosen by looking at the largest buckets
+    // first, when the table is empty and they are easy to place.  The
+    // positions past the end of the entries are then remapped onto the
+    // entries that nothing hashed to, which makes the hash minimal.
+
+    size_t n = input.size();
+    if (n == 0)
+        return false;
+
+    numBuckets = (n + PERFECT_HASH_ENTRIES_PER_BUCKET - 1)
+        / PERFECT_HASH_ENTRIES_PER_BUCKET;
+    tableSize = n + n / 32 + 1;
+
+    std::vector<uint64_t> mixed(n);
+    std::vector<uint32_t> pilotOf;
+    std::vector<uint64_t> positionOf(n);
+
+    auto tryBuild = [&] () -> bool
+        {
+            for (size_t i = 0;  i < n;  ++i)
+                mixed[i] = mixHash(std::get<0>(input[i]) ^ seed);
+
+            // Sort the entries by bucket with a counting sort
+            std::vector<uint32_t> bucketStart(numBuckets + 1, 0);
+            for (auto & m: mixed)
+                ++bucketStart[scaleHash(m, numBuckets) + 1];
+            for (size_t b = 0;  b < numBuckets;  ++b)
+                bucketStart[b + 1] += bucketStart[b];
+
+            std::vector<uint32_t> entries(n);
+            {
+                std::vector<uint32_t> pos(bucketStart.begin(),
+                                          bucketStart.end() - 1);
+                for (size_t i = 0;  i < n;  ++i)
+                    entries[pos[scaleHash(mixed[i], numBuckets)]++] = i;
+            }
+
+            auto bucketSize = [&] (size_t b)
+                {
+                    return bucketStart[b + 1] - bucketStart[b];
+                };
+
+            std::vector<uint32_t> order(numBuckets);
+            for (size_t b = 0;  b < numBuckets;  ++b)
+                order[b] = b;
+            std::stable_sort(order.begin(), order.end(),
+                             [&] (uint32_t b1, uint32_t b2)
+                             {
+                                 return bucketSize(b1) > bucketSize(b2);
+                             });
+
+            std::vector<bool> taken(tableSize, false);
+            pilotOf.assign(numBuckets, 0);
+            compact_vector<uint64_t, 16> positions;
+
+            for (uint32_t b: order) {
+                size_t size = bucketSize(b);
+                if (size == 0)
+                    break;
+
+                for (uint32_t pilot = 0;  ;  ++pilot) {
+                    if (pilot == PERFECT_HASH_MAX_PILOT)
+                        return false;
+
+                    positions.clear();
+                    bool ok = true;
+                    for (size_t i = 0;  i < size && ok;  ++i) {
+                        uint64_t p = perfectHashPosition
+                            (mixed[entries[bucketStart[b] + i]], pilot,
+                             tableSize);
+                        ok = !taken[p]
+                            && std::find(positions.begin(), positions.end(), p)
+                            == positions.end();
+                        positions.push_back(p);
+                    }
+                    if (!ok)
+                        continue;
+
+                    for (size_t i = 0;  i < size;  ++i) {
+                        taken[positions[i]] = true;
+                        positionOf[entries[bucketStart[b] + i]] = positions[i];
+                    }
+                    pilotOf[b] = pilot;
+                    break;
+                }
+            }
+
+            return true;
+        };
+
+    bool built = false;
+    for (int attempt = 0;  attempt < PERFECT_HASH_MAX_SEEDS && !built;
+         ++attempt) {
+        seed = mixHash(attempt + 1);
+        built = tryBuild();
+    }
+
+    if (!built) {
+        numBuckets = tableSize = seed = 0;
+        return false;
+    }
+
+    perfectHash = true;
+    numEntries = n;
+
+    // Remap each position past the end onto an entry that nothing was
+    // placed in.  There are exactly as many of these as there are
+    // entries with a position past the end.
+    std::vector<bool> used(n, false);
+    for (auto & p: positionOf) {
+        if (p < n)
+            used[p] = true;
+    }
+
+    auto remapped = serializer.allocateWritableT<uint32_t>(tableSize - n);
+    std::fill(remapped.data(), remapped.data() + remapped.length(), 0);
+    size_t nextFree = 0;
+    for (auto & p: positionOf) {
+        if (p < n)
+            continue;
+        while (used[nextFree])
+            ++nextFree;
+        used[nextFree] = true;
+        remapped.data()[p - n] = nextFree;
+        p = nextFree;
+    }
+
+    uint32_t maxPilot = *std::max_element(pilotOf.begin(), pilotOf.end());
+    pilotBits = MLDB::highest_bit(maxPilot, -1) + 1;
+
+    // One extra word as the bit writer may touch the word after the
+    // last one it writes to
+    auto pilotStorage = serializer.allocateWritableT<uint32_t>
+        ((numBuckets * pilotBits + 31) / 32 + 1);
+    std::fill(pilotStorage.data(),
+              pilotStorage.data() + pilotStorage.length(), 0);
+
+    MLDB::Bit_Writer<uint32_t> pilotWriter(pilotStorage.data());
+    for (auto & p: pilotOf)
+        pilotWriter.write(p, pilotBits);
+
+    auto entryStorage = serializer.allocateWritableT<uint32_t>
+        ((n * entryBits() + 31) / 32 + 1);
+    std::fill(entryStorage.data(),
+              entryStorage.data() + entryStorage.length(), 0);
+
+    for (size_t i = 0;  i < n;  ++i) {
+        MLDB::Bit_Writer<uint32_t> writer(entryStorage.data());
+        writer.skip(entryBits() * positionOf[i]);
+        writer.write(std::get<1>(input[i]) + 1, chunkBits);
+        writer.write(std::get<2>(input[i]), offsetBits);
+        writer.write(mixed[i] & ((1U << FINGERPRINT_BITS) - 1),
+                     FINGERPRINT_BITS);
+    }
+
+    this->remap = remapped.freeze();
+    this->pilots = pilotStorage.freeze();
+    this->storage = entryStorage.freeze();
+
+    return true;
+}
+
+void
+PathIndexShard::
+initOpenAddressing(MappedSerializer & serializer,
+                   const std::vector<std::tuple<uint64_t, int, int> > & input)
+{
+    perfectHash = false;
+
+    // Create a hash that's 50% full at the end, by doubling the
+    // size.  We want to leave plenty of space since we handle
+    // collisions by simply advancing, and so a large number of
+    // contiguous collisions can make lookups really slow.
+    numEntries = input.size() * 2;
+
+    size_t wordsRequired
+        = (numEntries * (chunkBits + offsetBits) + 31) / 32;
+
+    auto storage = serializer.allocateWritableT<uint32_t>(wordsRequired);
+    std::fill(storage.data(), storage.data() + storage.length(), 0);
+
+    // Expansion factor to turn a hash value into a position in the
+    // bucket.  This is done linearly so that we access memory
+    // sequentially.
+    factor = 2.0 * input.size() / std::numeric_limits<uint64_t>::max();
+
+    auto setEntry = [&] (size_t bucket, int chunkNumber, int indexInChunk)
+        {
+            MLDB::Bit_Writer<uint32_t> writer(storage.data());
+            writer.skip((chunkBits + offsetBits) * bucket);
+            writer.write(chunkNumber + 1, chunkBits);
+            writer.write(indexInChunk, offsetBits);
+        };
+
+    auto entryIsOccupied = [&] (size_t bucket) -> bool
+        {
+            MLDB::Bit_Extractor<uint32_t> bits(storage.data());
+            bits.advance((chunkBits + offsetBits) * bucket);
+            uint32_t chunk = bits.extract<uint32_t>(chunkBits);
+            return chunk > 0;
+        };
+
+    int collisions = 0;
+    size_t maxOffset = 0;
+    size_t totalOffset = 0;
+
+    for (size_t idx = 0;  idx < input.size();  ++idx) {
+        auto & i = input[idx];
+        uint64_t hash = std::get<0>(i);
+        int chunkNumber = std::get<1>(i);
+        int indexInChunk = std::get<2>(i);
+
+        size_t bucket = getBucket(hash);
+
+        collisions += entryIsOccupied(bucket);
+
+        size_t offset = 0;
+
+        for (int i = 0;  i < 1000;  ++i) /*while (true)*/ {
+            if (!entryIsOccupied(bucket)) {
+                // empty
+                setEntry(bucket, chunkNumber, indexInChunk);
+                break;
+            }
+            else {
+                ++bucket;
+                ++offset;
+                if (bucket == numEntries)
+                    bucket = 0;
+                if (i == 999) {
+                    cerr << "Error with collisions" << endl;
+                    cerr << "bucket = " << bucket << endl;
+                    cerr << "offset = " << offset << endl;
+                    cerr << "numEntries = " << numEntries << endl;
+                    throw AnnotatedException(500, "Hash bucket error");
+                }
+            }
+        }
+
+        maxOffset = std::max(maxOffset, offset);
+        totalOffset += offset;
+    }
+
+    //cerr << "collision rate = " << 100.0 * collisions / input.size()
+    //     << "%" << endl;
+    //cerr << "max offset = " << maxOffset << endl;
+    //cerr << "avg offset = " << 1.0 * totalOffset / input.size() << endl;
+
+    this->storage = storage.freeze();
+}
+
+size_t
+PathIndexShard::
+getBucket(uint64_t hash) const
+{
+    size_t bucket = hash * factor;
+    ExcAssertGreaterEqual(bucket, 0);
+    ExcAssertLess(bucket, numEntries);
+    return bucket;
+}
+
+size_t
+PathIndexShard::
+getPerfectHashEntry(uint64_t mixed) const
+{
+    MLDB::Bit_Extractor<uint32_t> bits(pilots.data());
+    bits.advance(pilotBits * scaleHash(mixed, numBuckets));
+    uint32_t pilot = bits.extract<uint32_t>(pilotBits);
+    uint64_t position = perfectHashPosition(mixed, pilot, tableSize);
+    if (position >= numEntries)
+        return remap.data()[position - numEntries];
+    return position;
+}
+
+int
+PathIndexShard::
+entryBits() const
+{
+    return chunkBits + offsetBits + (perfectHash ? FINGERPRINT_BITS : 0);
+}
+
+bool
+PathIndexShard::
+mayContain(uint64_t hash) const
+{
+    if (bloomBlocks == 0)
+        return true;
+
+    uint64_t h = mixHash(hash ^ BLOOM_SEED);
+    const uint32_t * block
+        = bloom.data() + scaleHash(h, bloomBlocks) * BLOOM_WORDS_PER_BLOCK;
+    uint32_t missing = 0;
+    for (size_t j = 0;  j < BLOOM_WORDS_PER_BLOCK;  ++j) {
+        missing |= ~block[j] & (1U << (((uint32_t)h * BLOOM_SALT[j]) >> 27));
+    }
+    return missing == 0;
+}
+
+compact_vector<std::pair<int, int>, 4>
+PathIndexShard::
+pathPossibleChunks(uint64_t hash) const
+{
+    compact_vector<std::pair<int, int>, 4> result;
+    if (numEntries == 0 || !mayContain(hash))
+        return result;
+
+    if (perfectHash) {
+        uint64_t mixed = mixHash(hash ^ seed);
+        MLDB::Bit_Extractor<uint32_t> bits(storage.data());
+        bits.advance(entryBits() * getPerfectHashEntry(mixed));
+        uint32_t chunk = bits.extract<uint32_t>(chunkBits) - 1;
+        uint32_t offset = bits.extract<uint32_t>(offsetBits);
+        uint32_t fingerprint = bits.extract<uint32_t>(FINGERPRINT_BITS);
+        if (fingerprint == (mixed & ((1U << FINGERPRINT_BITS) - 1)))
+            result.emplace_back(chunk, offset);
+        return result;
+    }
+
+    size_t bucket = hash * factor;
+    while (entryIsOccupied(bucket)) {
+        result.push_back(getEntry(bucket));
+        ++bucket;
+        if (bucket == numEntries)
+            bucket = 0;
+    }
+
+    return result;
+}
+
+size_t
+PathIndexShard::
+memusage() const
+{
+    return sizeof(*this) + storage.memusage() + bloom.memusage()
+        + pilots.memusage() + remap.memusage();
+}
+
+std::pair<uint32_t, uint32_t>
+PathIndexShard::
+getEntry(size_t bucket) const
+{
+    MLDB::Bit_Extractor<uint32_t> bits(storage.data());
+    bits.advance(entryBits() * bucket);
+    uint32_t chunk = bits.extract<uint32_t>(chunkBits) - 1;
+    uint32_t offset = bits.extract<uint32_t>(offsetBits);
+    return {chunk, offset};
+}
+
+bool
+PathIndexShard::
+entryIsOccupied(size_t bucket) const
+{
+    MLDB::Bit_Extractor<uint32_t> bits(storage.data());
+    bits.advance(entryBits() * bucket);
+    uint32_t chunk = bits.extract<uint32_t>(chunkBits);
+    return chunk > 0;
+}
+
+void
+PathIndexShard::
+serialize(StructuredSerializer & serializer) const
+{
+    serializer.newObject<PathIndexMetadata>("md.json", *this);
+    serializer.addRegion(storage, "rowindex");
+    if (bloomBlocks)
+        serializer.addRegion(bloom, "bloom");
+    if (perfectHash) {
+        serializer.addRegion(pilots, "pilots");
+        serializer.addRegion(remap, "remap");
+    }
+}
+
+void
+PathIndexShard::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    reconstituter.getObject<PathIndexMetadata>("md.json", *this);
+    storage = reconstituter.getRegionT<uint32_t>("rowindex");
+    if (bloomBlocks)
+        bloom = reconstituter.getRegionT<uint32_t>("bloom");
+    if (perfectHash) {
+        pilots = reconstituter.getRegionT<uint32_t>("pilots");
+        remap = reconstituter.getRegionT<uint32_t>("remap");
+    }
+}
+
+
+/*****************************************************************************/
+/* PATH INDEX LAYER                                                          */
+/*****************************************************************************/
+
+IMPLEMENT_STRUCTURE_DESCRIPTION(PathIndexLayerMetadata)
+{
+    setVersion(1);
+    addField("firstChunk", &PathIndexLayerMetadata::firstChunk, "");
+    addField("numChunks", &PathIndexLayerMetadata::numChunks, "");
+    addField("numRows", &PathIndexLayerMetadata::numRows, "");
+}
+
+size_t
+PathIndexLayer::
+memusage() const
+{
+    size_t result = sizeof(*this);
+    for (auto & shard: shards) {
+        result += shard.memusage();
+    }
+    return result;
+}
+
+void
+PathIndexLayer::
+serialize(StructuredSerializer & serializer) const
+{
+    serializer.newObject<PathIndexLayerMetadata>("md.json", *this);
+    for (size_t i = 0;  i < INDEX_SHARDS;  ++i) {
+        shards[i].serialize(*serializer.newStructure(i));
+    }
+}
+
+void
+PathIndexLayer::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    reconstituter.getObject<PathIndexLayerMetadata>("md.json", *this);
+    for (size_t i = 0;  i < INDEX_SHARDS;  ++i) {
+        shards[i].reconstitute(*reconstituter.getStructure(i));
+    }
+}
+
+
+/*****************************************************************************/
+/* PATH INDEX                                                                */
+/*****************************************************************************/
+
+std::vector<std::tuple<int, int, int, int> >
+PathIndex::
+add(MappedSerializer & serializer,
+    uint32_t firstChunkNumber,
+    const std::vector<const MutablePathIndex::ChunkEntries *> & chunks,
+    const GetChunkEntries & getChunkEntries,
+    const GetRowHash & getRowHash,
+    const PathIndexParameters & params)
+{
+    if (chunks.empty())
+        return {};
+
+    if (!layers.empty()) {
+        ExcAssertEqual(layers.back()->firstChunk + layers.back()->numChunks,
+                       firstChunkNumber);
+    }
+
+    uint64_t numRows = 0;
+    for (auto & c: chunks) {
+        for (auto & e: c->toInsert)
+            numRows += e.size();
+    }
+
+    // Take the newest layers that aren't at least twice as big as what
+    // we're adding, so that the layers at least double in size from the
+    // newest to the oldest.
+    size_t numKept = layers.size();
+    while (numKept > 0 && layers[numKept - 1]->numRows < 2 * numRows) {
+        numRows += layers[numKept - 1]->numRows;
+        --numKept;
+    }
+
+    uint32_t firstMerged = firstChunkNumber;
+    if (numKept < layers.size())
+        firstMerged = layers[numKept]->firstChunk;
+
+    // Hash the rows of the layers we're merging again
+    std::vector<MutablePathIndex::ChunkEntries>
+        mergedEntries(firstChunkNumber - firstMerged);
+    parallelMap(0, mergedEntries.size(), [&] (size_t i)
+                {
+                    getChunkEntries(firstMerged + i, mergedEntries[i]);
+                });
+
+    std::vector<const MutablePathIndex::ChunkEntries *> allChunks;
+    allChunks.reserve(mergedEntries.size() + chunks.size());
+    for (auto & e: mergedEntries)
+        allChunks.push_back(&e);
+    allChunks.insert(allChunks.end(), chunks.begin(), chunks.end());
+
+    MutablePathIndex toFreeze;
+    toFreeze.add(firstMerged, allChunks);
+
+    // Look for the new rows in the layers that are kept.  Collisions
+    // with the merged ones are found when they're frozen together.
+    std::vector<std::tuple<int, int, int, int> >
+        possibleCollisions[INDEX_SHARDS];
+
+    auto onShard = [&] (int shardNumber)
+        {
+            for (auto & e: toFreeze.index[shardNumber]) {
+                uint64_t hash = std::get<0>(e);
+                if (std::get<1>(e) < firstChunkNumber)
+                    continue;
+                for (size_t i = 0;  i < numKept;  ++i) {
+                    for (auto & c: layers[i]->pathPossibleChunks(hash)) {
+                        if (getRowHash(c.first, c.second) == hash) {
+                            possibleCollisions[shardNumber].emplace_back
+                                (c.first, c.second,
+                                 std::get<1>(e), std::get<2>(e));
+                        }
+                    }
+                }
+            }
+        };
+
+    if (numKept > 0)
+        parallelMap(0, INDEX_SHARDS, onShard);
+
+    auto frozen = toFreeze.freeze(serializer, params);
+
+    std::vector<std::tuple<int, int, int, int> > collisions
+        = std::move(frozen.second);
+    for (auto & c: possibleCollisions) {
+        collisions.insert(collisions.end(), c.begin(), c.end());
+    }
+
+    layers.resize(numKept);
+    layers.emplace_back
+        (std::make_shared<PathIndexLayer>(std::move(frozen.first)));
+
+    return collisions;
+}
+
+size_t
+PathIndex::
+memusage() const
+{
+    size_t result = sizeof(*this);
+    for (auto & l: layers) {
+        result += l->memusage();
+    }
+    return result;
+}
+
+void
+PathIndex::
+serialize(StructuredSerializer & serializer) const
+{
+    // An empty index is saved as one empty layer, so that there is
+    // something in its directory
+    if (layers.empty()) {
+        PathIndexLayer().serialize(*serializer.newStructure(0));
+        return;
+    }
+
+    for (size_t i = 0;  i < layers.size();  ++i) {
+        layers[i]->serialize(*serializer.newStructure(i));
+    }
+}
+
+void
+PathIndex::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    // The layers are the only things in the directory, numbered from 0
+    size_t numLayers = reconstituter.getDirectory().size();
+    layers.clear();
+    for (size_t i = 0;  i < numLayers;  ++i) {
+        auto layer = std::make_shared<PathIndexLayer>();
+        layer->reconstitute(*reconstituter.getStructure(i));
+        layers.emplace_back(std::move(layer));
+    }
+}
+
+} // namespace MLDB
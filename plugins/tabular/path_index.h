@@ -0,0 +1,326 @@
+/** path_index.h                                                   -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Index from the hash of a row name to the chunk and position within the
+    chunk of the row, used by the tabular dataset.
+*/
+
+#pragma once
+
+#include "mldb/block/memory_region.h"
+#include "mldb/types/path.h"
+#include "mldb/types/value_description_fwd.h"
+#include "mldb/utils/compact_vector.h"
+#include <vector>
+#include <tuple>
+#include <limits>
+#include <memory>
+#include <functional>
+
+
+namespace MLDB {
+
+struct PathIndexLayer;
+
+
+/*****************************************************************************/
+/* PATH INDEX PARAMETERS                                                     */
+/*****************************************************************************/
+
+/** Parameters used to control how a path index is frozen. */
+struct PathIndexParameters {
+    /// Put a blocked bloom filter in front of each shard, so that most
+    /// lookups of rows that don't exist return without touching the
+    /// index or the chunks.
+    bool bloomFilter = false;
+
+    /// Build a minimal perfect hash for each shard instead of an open
+    /// addressing table.  This takes longer to build but uses less memory
+    /// and returns at most one candidate per lookup.
+    bool perfectHash = false;
+};
+
+
+/*****************************************************************************/
+/* MUTABLE PATH INDEX                                                        */
+/*****************************************************************************/
+
+struct MutablePathIndex {
+    static constexpr size_t INDEX_SHARDS=32;
+
+    /** Hashes of the row names of a single chunk, split by shard.  These
+        are calculated as each chunk is frozen, before its chunk number
+        is known, and then merged into the index with add().
+    */
+    struct ChunkEntries {
+
+        void record(const Path & path,
+                    uint32_t indexInChunk)
+        {
+            record(path.hash(), indexInChunk);
+        }
+
+        void record(uint64_t hash,
+                    uint32_t indexInChunk)
+        {
+            int shard = getShard(hash);
+            toInsert[shard].emplace_back(hash, indexInChunk);
+            maxChunkIndex = std::max(maxChunkIndex, indexInChunk);
+        }
+
+        std::vector<std::pair<uint64_t, uint32_t> > toInsert[INDEX_SHARDS];
+        uint32_t maxChunkIndex = 0;
+    };
+
+    /** Add the rows of the given chunks, which are numbered consecutively
+        from firstChunkNumber.  The shards are merged in parallel.  Each
+        one is kept sorted, so only the new entries need to be sorted
+        before being merged with the existing ones.
+    */
+    void add(uint32_t firstChunkNumber,
+             const std::vector<const ChunkEntries *> & chunks);
+
+    /** Freeze the index into a layer of a PathIndex.  Returns the layer
+        and a list of possible collisions, with (chunk1, offset1, chunk2,
+        offset2) as the format, which are pairs of rows with the same hash.
+    */
+    std::pair<PathIndexLayer, std::vector<std::tuple<int, int, int, int> > >
+    freeze(MappedSerializer & serializer,
+           const PathIndexParameters & params = PathIndexParameters()) const;
+
+    /// Index from hash to (chunk, indexInChunk), sorted within each shard
+    std::vector<std::tuple<uint64_t, int, int> > index[INDEX_SHARDS];
+    uint32_t maxChunkIndex = 0;
+    uint32_t minChunkNumber = std::numeric_limits<uint32_t>::max();
+    uint32_t maxChunkNumber = 0;
+    uint64_t numRows = 0;
+
+    static int getShard(uint64_t hash)
+    {
+        return (hash >> 23) % INDEX_SHARDS;
+    }
+};
+
+
+/*****************************************************************************/
+/* PATH INDEX                                                                */
+/*****************************************************************************/
+
+struct PathIndexMetadata {
+    // Bits required to serialize a chunk number
+    uint8_t chunkBits = 0;
+
+    // Bits required to serialize an offset
+    uint8_t offsetBits = 0;
+
+    // How many entries are in storage?
+    uint64_t numEntries = 0;
+
+    // Factor to multiply by to turn a hash value into an entry number
+    double factor = 0.0;
+
+    // Number of 256 bit blocks in the bloom filter; zero means none
+    uint64_t bloomBlocks = 0;
+
+    // Is storage indexed by a minimal perfect hash rather than by
+    // open addressing?  If so, there is one entry per row.
+    bool perfectHash = false;
+
+    // Perfect hash: number of buckets that hashes are split into, each
+    // with its own pilot value
+    uint64_t numBuckets = 0;
+
+    // Perfect hash: number of positions the pilots map into, of which
+    // those past numEntries are remapped onto the free entries
+    uint64_t tableSize = 0;
+
+    // Perfect hash: bits required to serialize a pilot value
+    uint8_t pilotBits = 0;
+
+    // Perfect hash: seed used to mix the hashes
+    uint64_t seed = 0;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(PathIndexMetadata);
+
+struct PathIndexShard: public PathIndexMetadata {
+
+    /** Initialize the index in the shard.  Returns a list of possible
+        collisions, with (chunk1, offset1, chunk2, offset2) as the
+        format.
+    */
+    std::vector<std::tuple<int, int, int, int> >
+    init(MappedSerializer & serializer,
+         const std::vector<std::tuple<uint64_t, int, int> > & input,
+         size_t numChunks,
+         size_t maxChunkSize,
+         const PathIndexParameters & params = PathIndexParameters());
+
+    compact_vector<std::pair<int, int>, 4>
+    pathPossibleChunks(const Path & path) const
+    {
+        return pathPossibleChunks(path.hash());
+    }
+
+    compact_vector<std::pair<int, int>, 4>
+    pathPossibleChunks(uint64_t hash) const;
+
+    /** Could the given hash be in the shard?  This returns false for most
+        hashes that aren't there if there is a bloom filter, and true
+        otherwise.
+    */
+    bool mayContain(uint64_t hash) const;
+
+    size_t memusage() const;
+
+    void serialize(StructuredSerializer & serializer) const;
+
+    void reconstitute(StructuredReconstituter & reconstituter);
+
+    // Hash is implicit via position in the entry map (we take the top x bits)
+    // It returns the chunk number that contains that hash portion
+    // linear chaining
+
+    // Actual storage for bit-packed values
+    FrozenMemoryRegionT<uint32_t> storage;
+
+    // Blocked bloom filter, with 8 words per block
+    FrozenMemoryRegionT<uint32_t> bloom;
+
+    // Perfect hash: bit-packed pilot of each bucket
+    FrozenMemoryRegionT<uint32_t> pilots;
+
+    // Perfect hash: entry number of each position past numEntries
+    FrozenMemoryRegionT<uint32_t> remap;
+
+private:
+    void initBloom(MappedSerializer & serializer,
+                   const std::vector<std::tuple<uint64_t, int, int> > & input);
+
+    bool initPerfectHash(MappedSerializer & serializer,
+                         const std::vector<std::tuple<uint64_t, int, int> > & input);
+
+    void initOpenAddressing(MappedSerializer & serializer,
+                            const std::vector<std::tuple<uint64_t, int, int> > & input);
+
+    size_t getBucket(uint64_t hash) const;
+
+    size_t getPerfectHashEntry(uint64_t hash) const;
+
+    int entryBits() const;
+
+    std::pair<uint32_t, uint32_t> getEntry(size_t bucket) const;
+
+    bool entryIsOccupied(size_t bucket) const;
+};
+
+
+struct PathIndexLayerMetadata {
+    // Chunks whose rows are in the layer, which are consecutive
+    uint32_t firstChunk = 0;
+    uint32_t numChunks = 0;
+
+    // Number of rows in those chunks
+    uint64_t numRows = 0;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(PathIndexLayerMetadata);
+
+/** Frozen index of the rows of a range of chunks.  A PathIndex is made
+    of several of these.
+*/
+struct PathIndexLayer: public PathIndexLayerMetadata {
+    static constexpr size_t INDEX_SHARDS=MutablePathIndex::INDEX_SHARDS;
+
+    compact_vector<std::pair<int, int>, 4>
+    pathPossibleChunks(uint64_t hash) const
+    {
+        int shard = MutablePathIndex::getShard(hash);
+        return shards[shard].pathPossibleChunks(hash);
+    }
+
+    size_t memusage() const;
+
+    void serialize(StructuredSerializer & serializer) const;
+
+    void reconstitute(StructuredReconstituter & reconstituter);
+
+    // Hash is implicit via position in the entry map (we rescale the
+    // hash range)
+    // It returns the chunk number that contains that hash portion
+    // linear chaining
+    PathIndexShard shards[INDEX_SHARDS];
+};
+
+/** Index of the rows of all chunks of a dataset.  It is made of frozen
+    layers, each covering a range of chunks, so that adding chunks only
+    needs the new rows to be indexed rather than all of them.  Layers
+    are shared between copies of the index, and never modified.
+*/
+struct PathIndex {
+    static constexpr size_t INDEX_SHARDS=MutablePathIndex::INDEX_SHARDS;
+
+    /// Fills in the row hashes of the given chunk, like those passed to
+    /// add().  Called from several threads at once.
+    typedef std::function<void (uint32_t chunkNumber,
+                                MutablePathIndex::ChunkEntries & entries)>
+        GetChunkEntries;
+
+    /// Returns the hash of the given row of the given chunk.  Called from
+    /// several threads at once.
+    typedef std::function<uint64_t (uint32_t chunkNumber,
+                                    uint32_t indexInChunk)>
+        GetRowHash;
+
+    compact_vector<std::pair<int, int>, 4>
+    pathPossibleChunks(const Path & path) const
+    {
+        return pathPossibleChunks(path.hash());
+    }
+
+    compact_vector<std::pair<int, int>, 4>
+    pathPossibleChunks(uint64_t hash) const
+    {
+        if (layers.size() == 1)
+            return layers[0]->pathPossibleChunks(hash);
+        compact_vector<std::pair<int, int>, 4> result;
+        for (auto & l: layers) {
+            for (auto & c: l->pathPossibleChunks(hash))
+                result.push_back(c);
+        }
+        return result;
+    }
+
+    /** Add the rows of the given chunks, which are numbered consecutively
+        from firstChunkNumber and follow those already in the index.
+        Their rows are frozen into a new layer, together with those of
+        the newest layers if they are less than twice as big, which keeps
+        the number of layers logarithmic in the number of rows.  The rows
+        of the layers that are merged are hashed again with
+        getChunkEntries, so the cost is proportional to the number of new
+        rows rather than to the size of the index.
+
+        Returns the possible collisions between the new rows and the
+        others in the index, in the format of MutablePathIndex::freeze().
+        getRowHash is used to check the candidates from the layers that
+        are kept.
+    */
+    std::vector<std::tuple<int, int, int, int> >
+    add(MappedSerializer & serializer,
+        uint32_t firstChunkNumber,
+        const std::vector<const MutablePathIndex::ChunkEntries *> & chunks,
+        const GetChunkEntries & getChunkEntries,
+        const GetRowHash & getRowHash,
+        const PathIndexParameters & params = PathIndexParameters());
+
+    size_t memusage() const;
+
+    void serialize(StructuredSerializer & serializer) const;
+
+    void reconstitute(StructuredReconstituter & reconstituter);
+
+    /// Oldest (and largest) first
+    std::vector<std::shared_ptr<const PathIndexLayer> > layers;
+};
+
+} // namespace MLDB
@@ -1,8 +1,12 @@
-/** frozen_column.cc                                               -*- C++ -*-
+/** string_frozen_column.cc                                        -*- C++ -*-
     Jeremy Barnes, 27 March 2016
     This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
 
-    Implementation of code to freeze columns into a binary format.
+    Frozen column format for string-valued columns, which stores the
+    distinct values sorted and front-coded in small buckets.  Each bucket
+    is stored as a blob in a frozen blob table, which will compress them
+    with a shared zstd dictionary when the column is large enough to
+    make it worthwhile.
 */
 
 #include "frozen_tables.h"
@@ -11,9 +15,6 @@
 #include "mldb/types/annotated_exception.h"
 #include "mldb/types/basic_value_descriptions.h"
 
-#include "mldb/ext/zstd/lib/dictBuilder/zdict.h"
-#include "mldb/ext/zstd/lib/zstd.h"
-
 #include "mldb/utils/possibly_dynamic_buffer.h"
 
 
@@ -22,98 +23,413 @@ using namespace std;
 
 namespace MLDB {
 
+namespace {
+
+/// Number of strings per front-coded bucket.  Random access needs to
+/// scan through at most this many entries (and decompress at most one
+/// bucket), so it should be kept small.
+static constexpr uint32_t STRING_BUCKET_SIZE = 16;
+
+size_t varintLength(uint64_t val)
+{
+    size_t result = 1;
+    while (val >= 128) {
+        val >>= 7;
+        ++result;
+    }
+    return result;
+}
+
+void appendVarint(std::string & buf, uint64_t val)
+{
+    while (val >= 128) {
+        buf.push_back((char)((val & 127) | 128));
+        val >>= 7;
+    }
+    buf.push_back((char)val);
+}
+
+uint64_t readVarint(const char * & p, const char * e)
+{
+    uint64_t result = 0;
+    int shift = 0;
+    for (;;) {
+        if (p == e) {
+            throw AnnotatedException(500, "Truncated front-coded string bucket");
+        }
+        uint8_t c = *p++;
+        result |= uint64_t(c & 127) << shift;
+        if (c < 128)
+            return result;
+        shift += 7;
+    }
+}
+
+size_t commonPrefixLength(const char * s1, size_t l1,
+                          const char * s2, size_t l2)
+{
+    size_t n = std::min(l1, l2);
+    size_t i = 0;
+    while (i < n && s1[i] == s2[i])
+        ++i;
+    return i;
+}
+
+bool lessByBytes(const CellValue & v1, const CellValue & v2)
+{
+    size_t l1 = v1.toStringLength(), l2 = v2.toStringLength();
+    int res = std::memcmp(v1.stringChars(), v2.stringChars(),
+                          std::min(l1, l2));
+    return res < 0 || (res == 0 && l1 < l2);
+}
+
+} // file scope
+
+
 /*****************************************************************************/
-/* STRING FROZEN COLUMN                                                      */
+/* COMPRESSED STRING FROZEN COLUMN                                           */
 /*****************************************************************************/
 
-/// Frozen column that stores each value as a string
-struct CompressedStringFrozenColumn: public FrozenColumn {
+struct CompressedStringFrozenColumnMetadata {
+    uint32_t numEntries = 0;
+    uint64_t firstEntry = 0;
+    uint32_t numNonNullEntries = 0;
+    uint32_t numDistinct = 0;
+    bool hasNulls = false;
+    bool allAscii = true;
+    ColumnTypes columnTypes;
+};
+
+IMPLEMENT_STRUCTURE_DESCRIPTION(CompressedStringFrozenColumnMetadata)
+{
+    setVersion(1);
+    addField("numEntries", &CompressedStringFrozenColumnMetadata::numEntries, "");
+    addField("firstEntry", &CompressedStringFrozenColumnMetadata::firstEntry, "");
+    addField("numNonNullEntries",
+             &CompressedStringFrozenColumnMetadata::numNonNullEntries, "");
+    addField("numDistinct", &CompressedStringFrozenColumnMetadata::numDistinct, "");
+    addField("hasNulls", &CompressedStringFrozenColumnMetadata::hasNulls, "");
+    addField("allAscii", &CompressedStringFrozenColumnMetadata::allAscii, "");
+    addField("columnTypes", &CompressedStringFrozenColumnMetadata::columnTypes, "");
+}
+
+/** Information calculated in columnSize() and re-used by freeze().  It
+    contains the sort order of the distinct values and the exact number
+    of bytes required for the front-coded buckets.
+*/
+struct CompressedStringSizingInfo {
+    CompressedStringSizingInfo(const TabularDatasetColumn & column)
+    {
+        const std::vector<CellValue> & vals = column.indexedVals;
+
+        sortedOrder.resize(vals.size());
+        for (size_t i = 0;  i < vals.size();  ++i)
+            sortedOrder[i] = i;
+
+        std::sort(sortedOrder.begin(), sortedOrder.end(),
+                  [&] (uint32_t i1, uint32_t i2)
+                  {
+                      return lessByBytes(vals[i1], vals[i2]);
+                  });
 
-    // This stores the underlying doubles or CellValues 
-    std::shared_ptr<const FrozenColumn> unwrapped;
+        for (size_t i = 0;  i < sortedOrder.size();  ++i) {
+            const CellValue & v = vals[sortedOrder[i]];
+            allAscii = allAscii && v.isAsciiString();
+            size_t len = v.toStringLength();
+            size_t prefix = 0;
+            if (i % STRING_BUCKET_SIZE != 0) {
+                const CellValue & prev = vals[sortedOrder[i - 1]];
+                prefix = commonPrefixLength(prev.stringChars(),
+                                            prev.toStringLength(),
+                                            v.stringChars(), len);
+            }
+            bucketBytes += varintLength(prefix) + varintLength(len - prefix)
+                + len - prefix;
+        }
+
+        numEntries = column.maxRowNumber - column.minRowNumber + 1;
+        hasNulls = column.sparseIndexes.size() < numEntries;
+        size_t numBuckets
+            = (vals.size() + STRING_BUCKET_SIZE - 1) / STRING_BUCKET_SIZE;
+        int indexBits = bitsToHoldCount(vals.size() + hasNulls);
+        int offsetBits = bitsToHoldRange(bucketBytes);
+
+        bytesRequired
+            = 128 // sizeof the column object itself, plus metadata
+            + bucketBytes
+            + (indexBits * numEntries + 63) / 64 * 8
+            + (offsetBits * numBuckets + 63) / 64 * 8;
+    }
+
+    std::vector<uint32_t> sortedOrder;
+    size_t bucketBytes = 0;
+    size_t numEntries = 0;
+    bool hasNulls = false;
+    bool allAscii = true;
+    ssize_t bytesRequired = 0;
+};
+
+/** Frozen column that stores strings front-coded in sorted buckets, with
+    a bit-packed index from row to string number.  Accessing a single
+    value only requires decoding (and possibly decompressing) the single
+    bucket that contains it, and can stop as soon as the value is found.
+*/
+struct CompressedStringFrozenColumn
+    : public FrozenColumn,
+      public CompressedStringFrozenColumnMetadata {
 
     CompressedStringFrozenColumn(TabularDatasetColumn & column,
-                                 MappedSerializer & serializer,
-                                 const ColumnFreezeParameters & params)
-        : columnTypes(column.columnTypes)
+                                 CompressedStringSizingInfo & info,
+                                 MappedSerializer & serializer)
     {
         ExcAssert(!column.isFrozen);
-        // Convert the values to unwrapped doubles
-        column.valueIndex.clear();
-        size_t numNulls = column.columnTypes.numNulls;
-        column.columnTypes = ColumnTypes();
-        for (auto & v: column.indexedVals) {
-            v = v.coerceToNumber();
-            column.columnTypes.update(v);
+        const std::vector<CellValue> & vals = column.indexedVals;
+
+        this->columnTypes = std::move(column.columnTypes);
+        firstEntry = column.minRowNumber;
+        numEntries = info.numEntries;
+        numNonNullEntries = column.sparseIndexes.size();
+        numDistinct = vals.size();
+        hasNulls = info.hasNulls;
+        allAscii = info.allAscii;
+
+        // Build the front-coded buckets
+        std::vector<uint32_t> remapping(vals.size());
+        MutableBlobTable mutableBuckets;
+        std::string bucket;
+
+        for (size_t i = 0;  i < info.sortedOrder.size();  ++i) {
+            remapping[info.sortedOrder[i]] = i;
+            const CellValue & v = vals[info.sortedOrder[i]];
+            size_t len = v.toStringLength();
+            size_t prefix = 0;
+            if (i % STRING_BUCKET_SIZE != 0) {
+                const CellValue & prev = vals[info.sortedOrder[i - 1]];
+                prefix = commonPrefixLength(prev.stringChars(),
+                                            prev.toStringLength(),
+                                            v.stringChars(), len);
+            }
+            appendVarint(bucket, prefix);
+            appendVarint(bucket, len - prefix);
+            bucket.append(v.stringChars() + prefix, len - prefix);
+
+            if (i % STRING_BUCKET_SIZE == STRING_BUCKET_SIZE - 1
+                || i == info.sortedOrder.size() - 1) {
+                mutableBuckets.add(std::move(bucket));
+                bucket.clear();
+            }
+        }
+
+        buckets = mutableBuckets.freeze(serializer);
+
+        // Build the row to string index
+        MutableIntegerTable mutableIndexes;
+        mutableIndexes.reserve(numEntries);
+
+        size_t index = 0;
+        for (auto & r_i: column.sparseIndexes) {
+            while (index < r_i.first) {
+                ExcAssert(hasNulls);
+                mutableIndexes.add(0);
+                ++index;
+            }
+            mutableIndexes.add(remapping[r_i.second] + hasNulls);
+            ++index;
         }
-        column.columnTypes.numNulls = numNulls;
 
-        unwrapped = column.freeze(serializer, params);
+        indexes = mutableIndexes.freeze(serializer);
     }
 
-    // Wrap a double (or null) into a string (or null)
-    static CellValue wrap(CellValue val)
+    CompressedStringFrozenColumn(StructuredReconstituter & reconstituter)
     {
-        if (val.empty())
-            return val;
-        return val.coerceToString();
+        reconstituteMetadataT<CompressedStringFrozenColumnMetadata>
+            (reconstituter, *this);
+        indexes.reconstitute(*reconstituter.getStructure("index"));
+        buckets.reconstitute(*reconstituter.getStructure("buckets"));
     }
 
-
-    virtual bool forEach(const ForEachRowFn & onRow) const
+    /// Return the string with the given index in sorted order
+    CellValue getString(uint32_t stringNumber) const
     {
-        auto onRow2 = [&] (size_t rowNum, const CellValue & val)
+        ExcAssertLess(stringNumber, numDistinct);
+        uint32_t bucketNumber = stringNumber / STRING_BUCKET_SIZE;
+        uint32_t entry = stringNumber % STRING_BUCKET_SIZE;
+
+        CellValue result;
+        auto onEntry = [&] (uint32_t n, const char * s, size_t len)
             {
-                return onRow(rowNum, wrap(val));
+                if (n < entry)
+                    return true;
+                result = makeString(s, len);
+                return false;
             };
 
-        return unwrapped->forEach(onRow2);
+        forEachInBucket(bucketNumber, onEntry);
+        return result;
     }
 
-    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    CellValue makeString(const char * s, size_t len) const
     {
-        auto onRow2 = [&] (size_t rowNum, const CellValue & val)
-            {
-                return onRow(rowNum, wrap(val));
-            };
+        return CellValue(s, len,
+                         allAscii ? STRING_IS_VALID_ASCII : STRING_UNKNOWN);
+    }
+
+    /** Decode the strings in the given bucket, calling onEntry(n, str, len)
+        for each of them in order.  Stops early if onEntry returns false.
+    */
+    template<typename Fn>
+    bool forEachInBucket(uint32_t bucketNumber, Fn && onEntry) const
+    {
+        const char * p;
+        size_t len;
+
+        PossiblyDynamicBuffer<char, 4096> buf(buckets.getBufferSize(bucketNumber));
+        if (buckets.needsBuffer(bucketNumber)) {
+            len = buf.size();
+            p = buckets.getContents(bucketNumber, buf.data(), buf.size());
+        }
+        else {
+            len = buckets.getSize(bucketNumber);
+            p = buckets.getContents(bucketNumber, nullptr, 0);
+        }
+
+        const char * e = p + len;
+
+        // Current string, reconstituted from the shared prefix and suffix
+        std::string current;
+
+        for (uint32_t n = 0;  p < e;  ++n) {
+            size_t prefix = readVarint(p, e);
+            size_t suffix = readVarint(p, e);
+            if (p + suffix > e || prefix > current.size()) {
+                throw AnnotatedException
+                    (500, "Corrupt front-coded string bucket");
+            }
 
-        return unwrapped->forEachDense(onRow2);
+            current.resize(prefix);
+            current.append(p, suffix);
+            p += suffix;
+
+            if (!onEntry(n, current.data(), current.size()))
+                return false;
+        }
+
+        return true;
+    }
+
+    CellValue decode(uint64_t index) const
+    {
+        if (hasNulls) {
+            if (index == 0)
+                return CellValue();
+            return getString(index - 1);
+        }
+        return getString(index);
+    }
+
+    bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
+    {
+        // Decoding each row independently would repeatedly scan buckets,
+        // so when most rows are accessed we decode all distinct values
+        // once up front.
+        std::vector<CellValue> distinct;
+        distinct.reserve(numDistinct);
+        forEachDistinctString([&] (const CellValue & v)
+                              {
+                                  distinct.emplace_back(v);
+                                  return true;
+                              });
+
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            if (i >= indexes.size()) {
+                if (!keepNulls)
+                    break;
+                if (!onRow(i + firstEntry, CellValue()))
+                    return false;
+                continue;
+            }
+
+            uint64_t index = indexes.get(i);
+            if (hasNulls) {
+                if (index == 0) {
+                    if (keepNulls && !onRow(i + firstEntry, CellValue()))
+                        return false;
+                    continue;
+                }
+                --index;
+            }
+
+            if (!onRow(i + firstEntry, distinct[index]))
+                return false;
+        }
+
+        return true;
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, false /* keep nulls */);
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, true /* keep nulls */);
     }
 
     virtual CellValue get(uint32_t rowIndex) const
     {
-        return wrap(unwrapped->get(rowIndex));
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= indexes.size())
+            return result;
+        ExcAssertLess(rowIndex, numEntries);
+        return decode(indexes.get(rowIndex));
     }
 
     virtual size_t size() const
     {
-        return unwrapped->size();
+        return numEntries;
     }
 
     virtual size_t memusage() const
     {
         return sizeof(*this)
-            + unwrapped->memusage();
+            + buckets.memusage()
+            + indexes.memusage();
+    }
+
+    template<typename Fn>
+    bool forEachDistinctString(Fn && fn) const
+    {
+        for (uint32_t b = 0;  b < buckets.size();  ++b) {
+            auto onEntry = [&] (uint32_t n, const char * s, size_t len)
+                {
+                    return fn(makeString(s, len));
+                };
+            if (!forEachInBucket(b, onEntry))
+                return false;
+        }
+        return true;
     }
 
     virtual bool
     forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
     {
-        auto fn2 = [&] (const CellValue & v)
-            {
-                return fn(wrap(v));
-            };
+        if (hasNulls || indexes.size() < numEntries) {
+            if (!fn(CellValue()))
+                return false;
+        }
 
-        return unwrapped->forEachDistinctValue(fn2);
+        return forEachDistinctString(fn);
     }
 
     virtual size_t nonNullRowCount() const override
     {
-        return unwrapped->nonNullRowCount();
+        return numNonNullEntries;
     }
 
-    ColumnTypes columnTypes;
-
     virtual ColumnTypes getColumnTypes() const
     {
         return columnTypes;
@@ -126,12 +442,20 @@ struct CompressedStringFrozenColumn: public FrozenColumn {
 
     virtual void serialize(StructuredSerializer & serializer) const
     {
-        unwrapped->serialize(serializer);
+        serializeMetadataT<CompressedStringFrozenColumnMetadata>(serializer, *this);
+        indexes.serialize(*serializer.newStructure("index"));
+        buckets.serialize(*serializer.newStructure("buckets"));
     }
+
+    /// Front-coded buckets of STRING_BUCKET_SIZE sorted distinct strings
+    FrozenBlobTable buckets;
+
+    /// Index into the sorted strings per row (plus one if hasNulls)
+    FrozenIntegerTable indexes;
 };
 
 struct CompressedStringFrozenColumnFormat: public FrozenColumnFormat {
-    
+
     virtual ~CompressedStringFrozenColumnFormat()
     {
     }
@@ -141,30 +465,12 @@ struct CompressedStringFrozenColumnFormat: public FrozenColumnFormat {
         return "Sc";
     }
 
-    struct CachedInfo {
-        uint64_t totalStrings = 0;
-        uint64_t totalBytes = 0;
-        std::string dict;
-    };
-
     virtual bool isFeasible(const TabularDatasetColumn & column,
                             const ColumnFreezeParameters & params,
                             std::shared_ptr<void> & cachedInfo) const override
     {
-        auto info = std::make_shared<CachedInfo>();
-        cachedInfo = info;
-
-        for (auto & v: column.indexedVals) {
-            if (v.isString()) {
-                info->totalBytes += v.toStringLength();
-                info->totalStrings += 1;
-            }
-        }
-
         return column.columnTypes.numStrings
-            && column.columnTypes.onlyStringsAndNulls()
-            && info->totalBytes > 50000000 // 50MB
-            && info->totalBytes / info->totalStrings > 64;
+            && column.columnTypes.onlyStringsAndNulls();
     }
 
     virtual ssize_t columnSize(const TabularDatasetColumn & column,
@@ -172,126 +478,31 @@ struct CompressedStringFrozenColumnFormat: public FrozenColumnFormat {
                                ssize_t previousBest,
                                std::shared_ptr<void> & cachedInfo) const override
     {
-        auto info = std::static_pointer_cast<CachedInfo>(cachedInfo);
-
-        // Let the dictionary size be 5% of the total
-        size_t dictionarySize = 131072;//32768; //info->totalBytes / 20;
-
-        std::string dictionary(dictionarySize, '\0');
-
-        static constexpr size_t TOTAL_SAMPLE_SIZE = 1024 * 1024;
-
-        // Give it the first 1MB to train on
-        std::string sampleBuffer;
-        sampleBuffer.reserve(2 * TOTAL_SAMPLE_SIZE);
-
-        std::vector<size_t> sampleSizes;
-        size_t currentOffset = 0;
-        size_t valNumber = 0;
-
-        // Accumulate the first 1MB of strings in a contiguous buffer
-
-        for (auto & v: column.indexedVals) {
-            if (currentOffset > TOTAL_SAMPLE_SIZE)
-                break;
-            size_t sampleSize = v.toStringLength();
-            sampleBuffer.append(v.toUtf8String().rawString());
-            sampleSizes.push_back(sampleSize);
-            currentOffset += sampleSize;
-            valNumber += 1;
-        }
-
-        Date before = Date::now();
-
-        // Perform the dictionary training
-        size_t result = ZDICT_trainFromBuffer(&dictionary[0],
-                                              dictionary.size(),
-                                              sampleBuffer.data(),
-                                              sampleSizes.data(),
-                                              sampleSizes.size());
-        if (ZDICT_isError(result)) {
-            throw AnnotatedException(500, "Error with dictionary: "
-                                      + string(ZDICT_getErrorName(result)));
-        }
-        
-        Date after = Date::now();
-        double elapsed = after.secondsSince(before);
-        before = after;
-
-        cerr << "created dictionary of " << result << " bytes from "
-             << currentOffset << " bytes of samples in "
-             << elapsed << " seconds" << endl;
-
-        // Now compress another 1MB to see what the ratio is...
-        std::shared_ptr<ZSTD_CDict> dict
-            (ZSTD_createCDict(dictionary.data(), result, 1 /* compression level */),
-             ZSTD_freeCDict);
-        
-        std::shared_ptr<ZSTD_CCtx> context
-            (ZSTD_createCCtx(), ZSTD_freeCCtx);
-
-        size_t compressedBytes = 0;
-        size_t numSamples = 0;
-        size_t uncompressedBytes = 0;
-        for (size_t i = 0 /*valNumber*/;  i < column.indexedVals.size();  ++i) {
-            const CellValue & v = column.indexedVals[i];
-            size_t len = v.toStringLength();
-            PossiblyDynamicBuffer<char, 65536> buf(ZSTD_compressBound(len));
-
-            size_t result
-                = ZSTD_compress_usingCDict(context.get(),
-                                           buf.data(), buf.size(),
-                                           v.stringChars(), len,
-                                           dict.get());
-
-            if (ZSTD_isError(result)) {
-                throw AnnotatedException(500, "Error with compressing: "
-                                          + string(ZSTD_getErrorName(result)));
-            }
-
-            uncompressedBytes += len;
-            compressedBytes += result;
-            numSamples += 1;
-
-            //if (uncompressedBytes > 1024 * 1024)
-            //    break;
-        }
-
-        after = Date::now();
-        elapsed = after.secondsSince(before);
-
-        cerr << "compressed " << numSamples << " samples with "
-             << uncompressedBytes << " bytes to " << compressedBytes
-             << " bytes at " << 100.0 * compressedBytes / uncompressedBytes
-             << "% compression at "
-             << numSamples / elapsed << "/s" << endl;
-
-        ssize_t totalBytesRequired = sizeof(CompressedStringFrozenColumn)
-            + dictionarySize
-            + compressedBytes
-            + 4 * column.indexedVals.size();
-
-        cerr << "result is " << totalBytesRequired << endl;
-
+        auto info = std::make_shared<CompressedStringSizingInfo>(column);
+        ssize_t result = info->bytesRequired;
+        cachedInfo = info;
         return result;
     }
-    
+
     virtual FrozenColumn *
     freeze(TabularDatasetColumn & column,
            MappedSerializer & serializer,
            const ColumnFreezeParameters & params,
            std::shared_ptr<void> cachedInfo) const override
     {
-        return new CompressedStringFrozenColumn(column, serializer, params);
+        auto infoCast
+            = std::static_pointer_cast<CompressedStringSizingInfo>
+            (std::move(cachedInfo));
+        return new CompressedStringFrozenColumn(column, *infoCast, serializer);
     }
 
     virtual FrozenColumn *
     reconstitute(StructuredReconstituter & reconstituter) const override
     {
-        throw AnnotatedException(600, "Tabular reconstitution not finished");
+        return new CompressedStringFrozenColumn(reconstituter);
     }
 };
 
-//static RegisterFrozenColumnFormatT<CompressedStringFrozenColumnFormat> regCompressedString;
+RegisterFrozenColumnFormatT<CompressedStringFrozenColumnFormat> regCompressedString;
 
 } // namespace MLDB
@@ -6,9 +6,12 @@ LIBMLDB_TABULAR_PLUGIN_SOURCES:= \
 	frozen_column.cc \
 	frozen_tables.cc \
 	string_frozen_column.cc \
+	encoded_integer_frozen_column.cc \
 	column_types.cc \
 	tabular_dataset_column.cc \
 	tabular_dataset_chunk.cc \
+	zone_map.cc \
+	path_index.cc \
 
 
 LIBMLDB_TABULAR_PLUGIN_LINK := \
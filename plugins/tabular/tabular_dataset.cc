@@ -10,6 +10,7 @@
 #include "frozen_column.h"
 #include "tabular_dataset_column.h"
 #include "tabular_dataset_chunk.h"
+#include "path_index.h"
 #include "mldb/arch/timers.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/utils/smart_ptr_utils.h"
@@ -20,7 +21,9 @@
 #include "mldb/base/parallel_merge_sort.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/hash_wrapper_description.h"
+#include "mldb/types/path_table.h"
 #include "mldb/types/set_description.h"
+#include "mldb/types/vector_description.h"
 #include "mldb/types/annotated_exception.h"
 #include "mldb/utils/atomic_shared_ptr.h"
 #include "mldb/utils/floating_point.h"
@@ -33,7 +36,15 @@
 #include "mldb/engine/dataset_utils.h"
 #include "mldb/types/db/persistent.h"
 #include "mldb/block/zip_serializer.h"
+#include "mldb/engine/dataset_scope.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/sql/sql_utils.h"
+#include "mldb/sql/sql_batch.h"
+#include "mldb/utils/progress.h"
+#include "mldb/rest/cancellation_exception.h"
 #include <mutex>
+#include <condition_variable>
+#include <thread>
 
 
 using namespace std;
@@ -43,362 +54,53 @@ namespace MLDB {
 
 static constexpr size_t NUM_PARALLEL_CHUNKS=8;
 
-struct PathIndex;
-
-
-/*****************************************************************************/
-/* MUTABLE PATH INDEX                                                        */
-/*****************************************************************************/
-
-struct MutablePathIndex {
-    static constexpr size_t INDEX_SHARDS=32;
-
-    struct Recorder {
-
-        Recorder(uint32_t chunkNumber,
-                 MutablePathIndex * owner)
-            : chunkNumber(chunkNumber),
-              owner(owner)
-        {
-        }
-
-        void record(const Path & path,
-                    uint32_t indexInChunk)
-        {
-            uint64_t hash = path.hash();
-            int shard = getShard(hash);
-            toInsert[shard].emplace_back(hash, indexInChunk);
-            maxChunkIndex = std::max(maxChunkIndex, indexInChunk);
-        }
-
-        void commit()
-        {
-            for (size_t i = 0;  i < INDEX_SHARDS;  ++i) {
-                size_t shard = (i + chunkNumber) % INDEX_SHARDS;
-                std::unique_lock<std::mutex> guard(owner->indexLock[shard]);
-
-                if (i == 0) {
-                    owner->maxChunkIndex
-                        = std::max(owner->maxChunkIndex, maxChunkIndex);
-                    owner->maxChunkNumber
-                        = std::max(owner->maxChunkNumber, chunkNumber);
-                }
-
-                for (auto & e: toInsert[shard]) {
-                    uint64_t hash = e.first;
-                    int32_t indexInChunk = e.second;
-                    owner->index[shard]
-                        .emplace_back(hash, chunkNumber, indexInChunk);
-                }
-            }
-        }
-
-        std::vector<std::pair<uint64_t, uint32_t> > toInsert[INDEX_SHARDS];
-        uint32_t chunkNumber;
-        MutablePathIndex * owner;
-        uint32_t maxChunkIndex = 0;
-    };
+namespace {
 
-    Recorder getRecorder(int chunkNumber)
+// Same ordering as the one used by Dataset::generateRowsWhere, so that
+// our scans return rows in the same order as the generic one
+struct SortByRowHash {
+    bool operator () (const RowPath & row1, const RowPath & row2)
     {
-        return Recorder(chunkNumber, this);
-    }
-
-    std::pair<PathIndex, std::vector<std::tuple<int, int, int, int> > >
-    freeze(MappedSerializer & serializer);
+        RowHash h1(row1), h2(row2);
 
-    /// Index from hash to (chunk, indexInChunk)
-    std::mutex indexLock[INDEX_SHARDS];
-    std::vector<std::tuple<uint64_t, int, int> > index[INDEX_SHARDS];
-    uint32_t maxChunkIndex = 0;
-    uint32_t maxChunkNumber = 0;
-
-    static int getShard(uint64_t hash)
-    {
-        return (hash >> 23) % INDEX_SHARDS;
+        return h1 < h2 || (h1 == h2 && row1 < row2);
     }
 };
 
+} // file scope
+
 
 /*****************************************************************************/
-/* PATH INDEX                                                                */
+/* TABULAR DATASET STATE METADATA                                            */
 /*****************************************************************************/
 
-struct PathIndexMetadata {
-    // Bits required to serialize a chunk number
-    uint8_t chunkBits = 0;
+/// Metadata for a saved tabular dataset, which is stored alongside its
+/// chunks and row index.
+struct TabularDatasetStateMetadata {
+    // Version of the saved format
+    int version = 1;
 
-    // Bits required to serialize an offset
-    uint8_t offsetBits = 0;
+    // Names of the dense columns, in the order they're stored in chunks
+    std::vector<ColumnPath> fixedColumns;
 
-    // How many entries are in storage?
-    uint64_t numEntries = 0;
+    // Number of chunks and rows
+    uint64_t numChunks = 0;
+    uint64_t rowCount = 0;
 
-    // Factor to multiply by to turn a hash value into an entry number
-    double factor = 0.0;
+    // Timestamp range; only meaningful when rowCount is non-zero
+    Date earliestTs;
+    Date latestTs;
 };
 
-IMPLEMENT_STRUCTURE_DESCRIPTION(PathIndexMetadata)
+IMPLEMENT_STRUCTURE_DESCRIPTION(TabularDatasetStateMetadata)
 {
     setVersion(1);
-    addField("chunkBits", &PathIndexMetadata::chunkBits, "");
-    addField("offsetBits", &PathIndexMetadata::offsetBits, "");
-    addField("numEntries", &PathIndexMetadata::numEntries, "");
-    addField("factor", &PathIndexMetadata::factor, "");
-}
-
-struct PathIndexShard: public PathIndexMetadata {
-    
-    size_t getBucket(uint64_t hash) const
-    {
-        size_t bucket = hash * factor;
-        ExcAssertGreaterEqual(bucket, 0);
-        ExcAssertLess(bucket, numEntries);
-        return bucket;
-    }
-
-    /** Initialize the index in the shard.  Returns a list of possible
-        collisions, with (shard1, offset1, shard2, offset2) as the
-        format.
-    */
-    std::vector<std::tuple<int, int, int, int> >
-    init(MappedSerializer & serializer,
-         std::vector<std::tuple<uint64_t, int, int> > input,
-         size_t numChunks,
-         size_t maxChunkSize)
-    {
-        std::vector<std::tuple<int, int, int, int> > possibleCollisions;
-
-        std::sort(input.begin(), input.end());
-
-        chunkBits = MLDB::highest_bit(numChunks, -1) + 1;
-        offsetBits = MLDB::highest_bit(maxChunkSize - 1, -1) + 1;
-
-        // Create a hash that's 50% full at the end, by doubling the
-        // size.  We want to leave plenty of space since we handle
-        // collisions by simply advancing, and so a large number of
-        // contiguous collisions can make lookups really slow.
-        numEntries = input.size() * 2;
-
-        size_t wordsRequired
-            = (numEntries * (chunkBits + offsetBits) + 31) / 32;
-        
-        auto storage = serializer.allocateWritableT<uint32_t>(wordsRequired);
-        std::fill(storage.data(), storage.data() + storage.length(), 0);
-
-        // Expansion factor to turn a hash value into a position in the
-        // bucket.  This is done linearly so that we access memory
-        // sequentially.
-        factor = 2.0 * input.size() / std::numeric_limits<uint64_t>::max();
-
-        auto setEntry = [&] (size_t bucket, int chunkNumber, int indexInChunk)
-            {
-                MLDB::Bit_Writer<uint32_t> writer(storage.data());
-                writer.skip((chunkBits + offsetBits) * bucket);
-                writer.write(chunkNumber + 1, chunkBits);
-                writer.write(indexInChunk, offsetBits);
-            };
-
-        auto entryIsOccupied = [&] (size_t bucket) -> bool
-            {
-                MLDB::Bit_Extractor<uint32_t> bits(storage.data());
-                bits.advance((chunkBits + offsetBits) * bucket);
-                uint32_t chunk = bits.extract<uint32_t>(chunkBits);
-                return chunk > 0;
-            };
-     
-        int collisions = 0;
-        size_t maxOffset = 0;
-        size_t totalOffset = 0;
-        
-        for (size_t idx = 0;  idx < input.size();  ++idx) {
-            auto & i = input[idx];
-            uint64_t hash = std::get<0>(i);
-            int chunkNumber = std::get<1>(i);
-            int indexInChunk = std::get<2>(i);
-
-            if (idx > 0) {
-                if (std::get<0>(input[idx - 1]) == hash) {
-                    // potential collision
-                    int lastChunkNumber = std::get<1>(input[idx - 1]);
-                    int lastIndexInChunk = std::get<2>(input[idx - 1]);
-
-                    possibleCollisions.emplace_back
-                        (lastChunkNumber, lastIndexInChunk,
-                         chunkNumber, indexInChunk);
-                }
-            }
-
-            size_t bucket = getBucket(hash);
-
-            collisions += entryIsOccupied(bucket);
-
-            size_t offset = 0;
-
-            for (int i = 0;  i < 1000;  ++i) /*while (true)*/ {
-                if (!entryIsOccupied(bucket)) {
-                    // empty
-                    setEntry(bucket, chunkNumber, indexInChunk);
-                    break;
-                }
-                else {
-                    ++bucket;
-                    ++offset;
-                    if (bucket == numEntries)
-                        bucket = 0;
-                    if (i == 999) {
-                        cerr << "Error with collisions" << endl;
-                        cerr << "bucket = " << bucket << endl;
-                        cerr << "offset = " << offset << endl;
-                        cerr << "numEntries = " << numEntries << endl;
-                        throw AnnotatedException(500, "Hash bucket error");
-                    }
-                }
-            }
-
-            maxOffset = std::max(maxOffset, offset);
-            totalOffset += offset;
-        }
-
-        //cerr << "collision rate = " << 100.0 * collisions / input.size()
-        //     << "%" << endl;
-        //cerr << "max offset = " << maxOffset << endl;
-        //cerr << "avg offset = " << 1.0 * totalOffset / input.size() << endl;
-
-        this->storage = storage.freeze();
-
-        return possibleCollisions;
-    }
-
-    compact_vector<std::pair<int, int>, 4>
-    pathPossibleChunks(const Path & path) const
-    {
-        return pathPossibleChunks(path.hash());
-    }
-
-    compact_vector<std::pair<int, int>, 4>
-    pathPossibleChunks(uint64_t hash) const
-    {
-        compact_vector<std::pair<int, int>, 4> result;
-        if (numEntries == 0)
-            return result;
-        size_t bucket = hash * factor;
-        while (entryIsOccupied(bucket)) {
-            result.push_back(getEntry(bucket));
-            ++bucket;
-            if (bucket == numEntries)
-                bucket = 0;
-        }
-        
-        return result;
-    }
-
-    size_t memusage() const
-    {
-        return sizeof(*this) + storage.memusage();
-    }
-
-    std::pair<uint32_t, uint32_t>
-    getEntry(size_t bucket) const
-    {
-        MLDB::Bit_Extractor<uint32_t> bits(storage.data());
-        bits.advance((chunkBits + offsetBits) * bucket);
-        uint32_t chunk = bits.extract<uint32_t>(chunkBits) - 1;
-        uint32_t offset = bits.extract<uint32_t>(offsetBits);
-        return {chunk, offset};
-    }
-
-    bool entryIsOccupied(size_t bucket) const
-    {
-        MLDB::Bit_Extractor<uint32_t> bits(storage.data());
-        bits.advance((chunkBits + offsetBits) * bucket);
-        uint32_t chunk = bits.extract<uint32_t>(chunkBits);
-        return chunk > 0;
-    }
-
-    void serialize(StructuredSerializer & serializer) const
-    {
-        serializer.newObject<PathIndexMetadata>("md.json", *this);
-        serializer.addRegion(storage, "rowindex");
-    }
-
-    // Hash is implicit via position in the entry map (we take the top x bits)
-    // It returns the chunk number that contains that hash portion
-    // linear chaining
-
-    // Actual storage for bit-packed values
-    FrozenMemoryRegionT<uint32_t> storage;
-};
-
-
-struct PathIndex {
-    static constexpr size_t INDEX_SHARDS=MutablePathIndex::INDEX_SHARDS;
-
-    compact_vector<std::pair<int, int>, 4>
-    pathPossibleChunks(const Path & path) const
-    {
-        return pathPossibleChunks(path.hash());
-    }
-
-    compact_vector<std::pair<int, int>, 4>
-    pathPossibleChunks(uint64_t hash) const
-    {
-        int shard = MutablePathIndex::getShard(hash);
-        return shards[shard].pathPossibleChunks(hash);
-    }
-
-    size_t memusage() const
-    {
-        size_t result = sizeof(*this);
-        for (auto & shard: shards) {
-            result += shard.memusage();
-        }
-        return result;
-    }
-
-    void serialize(StructuredSerializer & serializer) const
-    {
-        for (size_t i = 0;  i < INDEX_SHARDS;  ++i) {
-            shards[i].serialize(*serializer.newStructure(i));
-        }
-    }
-
-    // Hash is implicit via position in the entry map (we rescale the
-    // hash range)
-    // It returns the chunk number that contains that hash portion
-    // linear chaining
-    PathIndexShard shards[INDEX_SHARDS];
-};
-
-std::pair<PathIndex, std::vector<std::tuple<int, int, int, int> > >
-MutablePathIndex::
-freeze(MappedSerializer & serializer)
-{
-    PathIndex result;
-    std::vector<std::tuple<int, int, int, int> >
-        possibleCollisions[INDEX_SHARDS];
-    std::atomic<size_t> totalPossibleCollisions(0);
-    
-    // Index each shard in parallel
-    auto onShard = [&] (int shardNumber)
-        {
-            possibleCollisions[shardNumber]
-            = result.shards[shardNumber]
-            .init(serializer,
-                  index[shardNumber],
-                  maxChunkNumber + 1, maxChunkIndex + 1);
-            totalPossibleCollisions += possibleCollisions[shardNumber].size();
-        };
-
-    parallelMap(0, INDEX_SHARDS, onShard);
-
-    std::vector<std::tuple<int, int, int, int> > collisions;
-    collisions.reserve(totalPossibleCollisions);
-    for (auto & c: possibleCollisions) {
-        collisions.insert(collisions.end(), c.begin(), c.end());
-    }
-    
-    return std::make_pair(result, collisions);
+    addField("version", &TabularDatasetStateMetadata::version, "");
+    addField("fixedColumns", &TabularDatasetStateMetadata::fixedColumns, "");
+    addField("numChunks", &TabularDatasetStateMetadata::numChunks, "");
+    addField("rowCount", &TabularDatasetStateMetadata::rowCount, "");
+    addField("earliestTs", &TabularDatasetStateMetadata::earliestTs, "");
+    addField("latestTs", &TabularDatasetStateMetadata::latestTs, "");
 }
 
 
@@ -413,32 +115,67 @@ freeze(MappedSerializer & serializer)
 struct TabularDataset::TabularDataStore
     : public ColumnIndex, public MatrixView {
 
-    // Find the optimal chunk size.  For narrow datasets, we want
-    // big chunks because it means less overhead.  However, for
-    // wide datasets we want a lot less as otherwise there is far too
-    // much memory allocated and the TLB can't hold all of the entries
-    // for all of the columns.
-    static size_t chunkSizeForNumColumns(size_t numColumns)
+    static constexpr size_t MIN_ROWS_PER_CHUNK = 16;
+    static constexpr size_t MAX_ROWS_PER_CHUNK = 1 << 20;
+
+    /// Bytes per value assumed before any chunk has been recorded
+    static constexpr size_t INITIAL_BYTES_PER_VALUE = 16;
+
+    // Find the optimal chunk size, which is the number of rows that
+    // fit in the chunk byte budget.  Narrow datasets get big chunks,
+    // which means less overhead.  Wide datasets get a lot less, as
+    // otherwise there is far too much memory allocated and the TLB
+    // can't hold all of the entries for all of the columns.  The size
+    // of a row is learnt from the chunks that have been recorded, so
+    // that wide, sparse rows are accounted for; the chunks also stop
+    // accepting rows once they have used the budget.
+    size_t chunkSizeForNumColumns(size_t numColumns) const
+    {
+        size_t bytesPerRow = lastBytesPerRow.load();
+        if (bytesPerRow == 0) {
+            bytesPerRow = MutableTabularDatasetChunk::ROW_OVERHEAD_BYTES
+                + std::max<size_t>(numColumns, 1) * INITIAL_BYTES_PER_VALUE;
+        }
+        size_t rowsPerChunk = config.chunkByteBudget / bytesPerRow;
+        return std::max(MIN_ROWS_PER_CHUNK,
+                        std::min(MAX_ROWS_PER_CHUNK, rowsPerChunk));
+    }
+
+    /// Create a new mutable chunk, sized for the chunk byte budget
+    std::shared_ptr<MutableTabularDatasetChunk>
+    newMutableChunk(size_t numColumns) const
     {
-        if (numColumns == 0)
-            numColumns = 1;
-        size_t rowsPerChunk
-            = std::min<size_t>(131072, 131072*numCpus()/numColumns);
-        if (rowsPerChunk < 16)
-            rowsPerChunk = 16;
-        return rowsPerChunk;
+        return std::make_shared<MutableTabularDatasetChunk>
+            (numColumns, chunkSizeForNumColumns(numColumns),
+             config.chunkByteBudget);
     }
 
     TabularDataStore(MldbEngine * engine,
                      TabularDatasetConfig config,
                      shared_ptr<spdlog::logger> logger)
         : engine(engine),
+          serializer(config.memoryPolicy),
           currentState(std::make_shared<CurrentState>(this, logger)),
           config(std::move(config)),
           backgroundJobsActive(0), logger(std::move(logger))
     {
         ExcAssert(this->logger);
         initRoutes();
+
+        if (!this->config.dataFileUrl.empty()
+            && tryGetUriObjectInfo(this->config.dataFileUrl.toString())) {
+            load(this->config.dataFileUrl);
+            if (this->config.warmup)
+                warmup(this->config.warmupColumns);
+        }
+    }
+
+    ~TabularDataStore()
+    {
+        // Stop any warmup that's still going
+        shutdown = true;
+        if (warmupThread.joinable())
+            warmupThread.join();
     }
 
     MldbEngine * engine = nullptr;
@@ -482,6 +219,10 @@ struct TabularDataset::TabularDataStore
         /// Total number of rows in the dataset
         int64_t rowCount = 0;
 
+        /// Number of commits that went into this state.  Each state that
+        /// is published has a higher version than the one before.
+        uint64_t version = 0;
+
         /// This indexes column names to their index, using new (fast) hash
         LightweightHash<uint64_t, int> columnIndex;
 
@@ -631,28 +372,44 @@ struct TabularDataset::TabularDataStore
                             std::move(sortedStrings),
                             maxNumBuckets);
 
-            WritableBucketList buckets(totalRows, desc.numBuckets());
+            // Each chunk looks up the buckets of its rows into its own
+            // part of the array, and the array is then packed
+            std::vector<size_t> chunkOffsets(chunks.size() + 1, 0);
+            for (size_t i = 0;  i < chunks.size();  ++i)
+                chunkOffsets[i + 1] = chunkOffsets[i] + chunks[i]->rowCount();
 
-            size_t numWritten = 0;
+            std::vector<uint32_t> bucketNumbers(totalRows);
+            std::atomic<size_t> numWritten(0);
+            std::atomic<bool> wrongChunkSize(false);
 
             auto onChunk2 = [&] (size_t i)
                 {
+                    std::vector<CellValue> values;
+                    values.reserve(chunks[i]->rowCount());
 
                     auto onRow = [&] (size_t rowNum, const CellValue & val)
                     {
-                        uint32_t bucket = desc.getBucket(val);
-                        buckets.write(bucket);
-                        ++numWritten;
+                        values.emplace_back(val);
                         return true;
                     };
                 
                     chunks[i]->columns[it->second]->forEachDense(onRow);
+
+                    numWritten += values.size();
+
+                    // Too many would overflow into the next chunk's part
+                    if (values.size() != chunks[i]->rowCount()) {
+                        wrongChunkSize = true;
+                        return;
+                    }
+
+                    desc.getBuckets(values.data(), values.size(),
+                                    bucketNumbers.data() + chunkOffsets[i]);
                 };
         
-            for (size_t i = 0;  i < chunks.size();  ++i)
-                onChunk2(i);
+            parallelMap(0, chunks.size(), onChunk2);
 
-            if (numWritten != totalRows) {
+            if (wrongChunkSize || numWritten != totalRows) {
                 throw AnnotatedException
                     (500, "Column " + column.toUtf8String()
                      + " had wrong number written ("
@@ -661,6 +418,9 @@ struct TabularDataset::TabularDataStore
                      + "dataset if possible");
             }
 
+            WritableBucketList buckets(totalRows, desc.numBuckets());
+            buckets.writeParallel(bucketNumbers.data(), totalRows);
+
             ExcAssertEqual(numWritten, totalRows);
 
             return std::make_tuple(std::move(buckets), std::move(desc));
@@ -932,19 +692,604 @@ struct TabularDataset::TabularDataStore
             return result;
         }
 
+        /// A term of the WHERE clause of the form "column op constant",
+        /// which can be tested against the zone map of each chunk.  The
+        /// op may also be "IS NULL" or "IS NOT NULL", with no constant,
+        /// which can be tested against the presence of each row too, or
+        /// "IN", with the values in constants.
+        struct ZoneMapConstraint {
+            ColumnPath columnName;
+            int columnIndex = -1;
+            std::string op;
+            CellValue constant;
+            std::vector<CellValue> constants;
+
+            /// Could a row of the chunk with this zone map match?
+            bool mayMatch(const ColumnZoneMap & zoneMap) const
+            {
+                if (op != "IN")
+                    return zoneMap.mayMatch(op, constant);
+                for (auto & c: constants) {
+                    if (zoneMap.mayMatch("=", c))
+                        return true;
+                }
+                return false;
+            }
+        };
+
+        /** Extract the terms of the top-level conjunction of the WHERE
+            clause that can be tested against the zone maps.  Terms
+            that can't are ignored; they are still evaluated for each
+            row of the chunks that aren't pruned.
+        */
+        void getZoneMapConstraints(const Utf8String & alias,
+                                   const SqlExpression & where,
+                                   std::vector<ZoneMapConstraint> & constraints) const
+        {
+            if (auto boolean
+                = dynamic_cast<const BooleanOperatorExpression *>(&where)) {
+                if (boolean->op == "AND" && boolean->lhs && boolean->rhs) {
+                    getZoneMapConstraints(alias, *boolean->lhs, constraints);
+                    getZoneMapConstraints(alias, *boolean->rhs, constraints);
+                }
+                return;
+            }
+
+            // Start a constraint on the column read by var, returning
+            // false if var doesn't read a column that we know of
+            auto initConstraint = [&] (const SqlExpression & var,
+                                       const std::string & op,
+                                       ZoneMapConstraint & result)
+                {
+                    auto readColumn
+                        = dynamic_cast<const ReadColumnExpression *>(&var);
+                    if (!readColumn)
+                        return false;
+
+                    result.columnName
+                        = removeTableName(alias, readColumn->columnName);
+                    auto it = columnIndex.find(result.columnName.oldHash());
+                    if (it == columnIndex.end())
+                        return false;
+                    result.columnIndex = it->second;
+                    result.op = op;
+                    return true;
+                };
+
+            auto addConstraint = [&] (const SqlExpression & var,
+                                      const std::string & op,
+                                      const SqlExpression & constant)
+                {
+                    auto readConstant
+                        = dynamic_cast<const ConstantExpression *>(&constant);
+                    if (!readConstant || !readConstant->constant.isAtom())
+                        return;
+
+                    ZoneMapConstraint result;
+                    if (!initConstraint(var, op, result))
+                        return;
+                    result.constant = readConstant->constant.getAtom();
+                    constraints.emplace_back(std::move(result));
+                };
+
+            if (auto comparison
+                = dynamic_cast<const ComparisonExpression *>(&where)) {
+                // Same comparison with the operands swapped
+                static const std::map<std::string, std::string> flipped = {
+                    { "=", "=" }, { "==", "==" }, { "<", ">" },
+                    { "<=", ">=" }, { ">", "<" }, { ">=", "<=" } };
+                auto it = flipped.find(comparison->op);
+                if (it == flipped.end())
+                    return;
+                addConstraint(*comparison->lhs, comparison->op,
+                              *comparison->rhs);
+                addConstraint(*comparison->rhs, it->second,
+                              *comparison->lhs);
+            }
+            else if (auto between
+                     = dynamic_cast<const BetweenExpression *>(&where)) {
+                if (between->notBetween)
+                    return;
+                addConstraint(*between->expr, ">=", *between->lower);
+                addConstraint(*between->expr, "<=", *between->upper);
+            }
+            else if (auto in = dynamic_cast<const InExpression *>(&where)) {
+                if (in->isNegative || !in->tuple || !in->tuple->isConstant())
+                    return;
+                ZoneMapConstraint result;
+                if (!initConstraint(*in->expr, "IN", result))
+                    return;
+                for (auto & c: in->tuple->clauses) {
+                    ExpressionValue val = c->constantValue();
+                    if (!val.isAtom())
+                        return;
+                    result.constants.emplace_back(val.getAtom());
+                }
+                constraints.emplace_back(std::move(result));
+            }
+            else if (auto like = dynamic_cast<const LikeExpression *>(&where)) {
+                // A string matching the pattern sorts at or after the part
+                // of the pattern before its first wildcard
+                auto pattern = dynamic_cast<const ConstantExpression *>
+                    (like->right.get());
+                if (like->isNegative || !pattern
+                    || !pattern->constant.isString())
+                    return;
+                Utf8String prefix;
+                for (auto c: pattern->constant.toUtf8String()) {
+                    if (c == '%' || c == '_')
+                        break;
+                    prefix += c;
+                }
+                ZoneMapConstraint result;
+                if (prefix.empty() || !initConstraint(*like->left, ">=", result))
+                    return;
+                result.constant = prefix;
+                constraints.emplace_back(std::move(result));
+            }
+            else if (auto isType
+                     = dynamic_cast<const IsTypeExpression *>(&where)) {
+                auto readColumn = dynamic_cast<const ReadColumnExpression *>
+                    (isType->expr.get());
+                if (isType->type != "null" || !readColumn)
+                    return;
+
+                ZoneMapConstraint result;
+                result.columnName
+                    = removeTableName(alias, readColumn->columnName);
+                auto it = columnIndex.find(result.columnName.oldHash());
+                if (it == columnIndex.end())
+                    return;
+
+                // Reading a variable also returns the structured columns
+                // under it, which would make it non-null even when the
+                // column itself is.
+                for (auto & c: columns) {
+                    if (c.columnName != result.columnName
+                        && c.columnName.startsWith(result.columnName))
+                        return;
+                }
+
+                result.columnIndex = it->second;
+                result.op = isType->notType ? "IS NOT NULL" : "IS NULL";
+                constraints.emplace_back(std::move(result));
+            }
+        }
+
+        /** Work out which columns an expression with the given unbound
+            entities could read, as (column index, column name) pairs for
+            TabularDatasetChunk::getRowColumns().  A variable reads the
+            column with its name and any structured columns under it.
+            Returns false if the expression could read any column, for
+            example because it has a wildcard or calls columnCount().
+        */
+        bool getProjectedColumns(const UnboundEntities & unbound,
+                                 const Utf8String & alias,
+                                 std::vector<std::pair<int, ColumnPath> > & result) const
+        {
+            if (!unbound.wildcards.empty()
+                || unbound.funcs.count("columnCount"))
+                return false;
+
+            // Variables scoped by a table name are only there in joins and
+            // sub-selects, where we don't try to work it out.
+            for (auto & t: unbound.tables) {
+                if (!t.second.vars.empty() || !t.second.wildcards.empty()
+                    || t.second.funcs.count(PathElement("columnCount")))
+                    return false;
+            }
+
+            std::vector<ColumnPath> read;
+            for (auto & v: unbound.vars) {
+                read.emplace_back(removeTableName(alias, v.first));
+            }
+
+            result.clear();
+            for (size_t i = 0;  i < columns.size();  ++i) {
+                const ColumnPath & columnName = columns[i].columnName;
+                for (auto & r: read) {
+                    if (columnName.startsWith(r)) {
+                        result.emplace_back(i, columnName);
+                        break;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        virtual std::function<ExpressionValue (const RowPath & row)>
+        getRowExprProjection(const UnboundEntities & unbound,
+                             const Utf8String & alias) const override
+        {
+            auto state = shared_from_this();
+
+            std::vector<std::pair<int, ColumnPath> > projected;
+            if (!getProjectedColumns(unbound, alias, projected)) {
+                return [=] (const RowPath & rowName)
+                    {
+                        return state->getRowExpr(rowName);
+                    };
+            }
+
+            return [=] (const RowPath & rowName) -> ExpressionValue
+                {
+                    int chunkNumber;
+                    int rowInChunk;
+                    std::tie(chunkNumber, rowInChunk)
+                        = state->lookupRow(rowName);
+
+                    return state->chunks.at(chunkNumber)
+                        ->getRowColumns(rowInChunk, projected);
+                };
+        }
+
+        /** A block of rows of a chunk, over which a WHERE clause is
+            executed in batch mode.  Columns are read straight from the
+            frozen columns into typed arrays where possible.
+        */
+        struct ChunkBlockBatch: public SqlBatch {
+            ChunkBlockBatch(const CurrentState & state,
+                            const TabularDatasetChunk & chunk,
+                            uint32_t begin, uint32_t end)
+                : SqlBatch(end - begin),
+                  state(state), chunk(chunk), begin(begin)
+            {
+            }
+
+            const CurrentState & state;
+            const TabularDatasetChunk & chunk;
+            uint32_t begin;
+
+            /// Executes an expression in row mode for a row of the chunk
+            std::function<ExpressionValue (const BoundSqlExpression & expr,
+                                           uint32_t rowInChunk)> onRow;
+
+            virtual bool readColumn(const ColumnPath & columnName,
+                                    const SqlSelection & selection,
+                                    SqlBatchVector & out) const override
+            {
+                // Reading a variable also returns the structured columns
+                // under it, which aren't atoms
+                for (auto & c: state.columns) {
+                    if (c.columnName != columnName
+                        && c.columnName.startsWith(columnName))
+                        return false;
+                }
+
+                size_t n = selection.size();
+                auto it = state.columnIndex.find(columnName.oldHash());
+                const FrozenColumn * column
+                    = chunk.maybeGetColumn(it == state.columnIndex.end()
+                                           ? -1 : it->second,
+                                           columnName);
+                if (!column || n == 0) {
+                    out.initAtoms(n);
+                    return true;
+                }
+
+                // Typed values are decoded for the whole range covered by
+                // the selection, which is usually most of the block
+                uint32_t rangeBegin = begin + selection.front();
+                uint32_t rangeEnd = begin + selection.back() + 1;
+                size_t rangeLength = rangeEnd - rangeBegin;
+                ColumnTypes types = column->getColumnTypes();
+
+                auto getNulls = [&] ()
+                    {
+                        std::vector<uint64_t> present((rangeLength + 63) / 64);
+                        column->getPresence(rangeBegin, rangeEnd,
+                                            present.data());
+                        for (size_t i = 0;  i < n;  ++i) {
+                            size_t bit = begin + selection[i] - rangeBegin;
+                            if (!((present[bit / 64] >> (bit % 64)) & 1))
+                                out.setNull(i);
+                        }
+                    };
+
+                if (types.onlyIntegersAndNulls()) {
+                    std::vector<int64_t> values(rangeLength);
+                    if (column->getRangeInt64(rangeBegin, rangeEnd,
+                                              values.data(), 0)) {
+                        out.initIntegers(n);
+                        for (size_t i = 0;  i < n;  ++i)
+                            out.ints[i] = values[begin + selection[i] - rangeBegin];
+                        getNulls();
+                        return true;
+                    }
+                }
+
+                if (types.onlyDoublesAndNulls()) {
+                    std::vector<double> values(rangeLength);
+                    if (column->getRangeDouble(rangeBegin, rangeEnd,
+                                               values.data())) {
+                        out.initDoubles(n);
+                        for (size_t i = 0;  i < n;  ++i)
+                            out.doubles[i] = values[begin + selection[i] - rangeBegin];
+                        getNulls();
+                        return true;
+                    }
+                }
+
+                std::vector<uint32_t> rows(n);
+                for (size_t i = 0;  i < n;  ++i)
+                    rows[i] = begin + selection[i];
+                std::vector<CellValue> values(n);
+                column->getSelection(rows.data(), n, values.data());
+                out.initCells(std::move(values));
+                return true;
+            }
+
+            virtual ExpressionValue evalRow(const BoundSqlExpression & expr,
+                                            uint32_t row) const override
+            {
+                return onRow(expr, begin + row);
+            }
+        };
+
+        /** Return a function that performs the same scan as fullScan,
+            but that skips the chunks whose zone maps show they can't
+            contain a matching row, and that only decodes the columns
+            that the WHERE clause reads for each row.  When the WHERE
+            clause can be executed in batch mode, it's executed over
+            blocks of rows rather than a row at a time.  Returns a null
+            function if none of these apply.
+        */
+        GenerateRowsWhereFunction
+        generateChunkScan(const Dataset & dataset,
+                          const Utf8String & alias,
+                          const SqlExpression & where,
+                          GenerateRowsWhereFunction fullScan) const
+        {
+            std::vector<ZoneMapConstraint> constraints;
+            getZoneMapConstraints(alias, where, constraints);
+
+            // Constraints on nullness, which are also applied to each row
+            // from the presence bitmaps of the frozen columns
+            std::vector<ZoneMapConstraint> presenceConstraints;
+            for (auto & c: constraints) {
+                if (c.op == "IS NULL" || c.op == "IS NOT NULL")
+                    presenceConstraints.push_back(c);
+            }
+
+            UnboundEntities unbound = where.getUnbound();
+            bool needsColumns = unbound.needsRow();
+            std::vector<std::pair<int, ColumnPath> > projected;
+            bool isProjected = needsColumns
+                && getProjectedColumns(unbound, alias, projected);
+
+            auto dsScope
+                = std::make_shared<SqlExpressionDatasetScope>(dataset, alias);
+            auto whereBound = where.bind(*dsScope);
+            bool batchMode = !!whereBound.batchExec;
+
+            if (constraints.empty() && !isProjected && !batchMode)
+                return GenerateRowsWhereFunction();
+
+            // Ranges of rows to scan, each within a single chunk.  The
+            // chunks are split up so that narrow datasets with only a
+            // few chunks can still be scanned in parallel.
+            static constexpr size_t ROWS_PER_BLOCK = 4096;
+            struct Block {
+                uint32_t chunk;
+                uint32_t begin;
+                uint32_t end;
+            };
+            std::vector<Block> blocks;
+            size_t numChunksScanned = 0;
+            size_t numRowsToScan = 0;
+
+            for (size_t i = 0;  i < chunks.size();  ++i) {
+                const TabularDatasetChunk & chunk = *chunks[i];
+                bool mayMatch = true;
+                for (auto & c: constraints) {
+                    // A column that's not in the chunk is null for all of
+                    // its rows
+                    const ColumnZoneMap * zoneMap
+                        = chunk.maybeGetZoneMap(c.columnIndex, c.columnName);
+                    if (!zoneMap ? c.op != "IS NULL"
+                        : !c.mayMatch(*zoneMap)) {
+                        mayMatch = false;
+                        break;
+                    }
+                }
+                if (!mayMatch)
+                    continue;
+
+                ++numChunksScanned;
+                numRowsToScan += chunk.rowCount();
+                for (size_t j = 0;  j < chunk.rowCount();  j += ROWS_PER_BLOCK) {
+                    blocks.push_back({ (uint32_t)i, (uint32_t)j,
+                                       (uint32_t)std::min(chunk.rowCount(),
+                                                          j + ROWS_PER_BLOCK) });
+                }
+            }
+
+            auto state = shared_from_this();
+
+            Utf8String explain
+                = "scan " + std::to_string(numChunksScanned) + " of "
+                + std::to_string(chunks.size()) + " chunks";
+            if (!constraints.empty())
+                explain += " selected by zone maps";
+            if (!presenceConstraints.empty())
+                explain += " using presence bitmaps";
+            if (isProjected)
+                explain += " reading " + std::to_string(projected.size())
+                    + " of " + std::to_string(columns.size()) + " columns";
+            explain += " filtering by where expression";
+            if (batchMode)
+                explain += " in batches";
+
+            return {[=] (ssize_t numToGenerate, Any token,
+                         const BoundParameters & params,
+                         const ProgressFunc & onProgress)
+                    -> std::pair<std::vector<RowPath>, Any>
+                {
+                    // Paged generation isn't supported by zone map scans
+                    if (numToGenerate != -1 || !token.empty())
+                        return fullScan(numToGenerate, token, params,
+                                        onProgress);
+
+                    std::vector<std::vector<RowPath> > blockOutput(blocks.size());
+                    std::atomic_ulong rowCount(0);
+                    ProgressState whereProgress(numRowsToScan);
+
+                    auto onBlock = [&] (size_t n)
+                    {
+                        const Block & block = blocks[n];
+                        const TabularDatasetChunk & chunk
+                            = *state->chunks[block.chunk];
+
+                        // Bit i is set if row block.begin + i passes the
+                        // constraints on nullness
+                        size_t numWords = (block.end - block.begin + 63) / 64;
+                        std::vector<uint64_t> mask;
+                        if (!presenceConstraints.empty()) {
+                            mask.resize(numWords, (uint64_t)-1);
+                            std::vector<uint64_t> present(numWords);
+                            for (auto & c: presenceConstraints) {
+                                const FrozenColumn * column
+                                    = chunk.maybeGetColumn(c.columnIndex,
+                                                           c.columnName);
+                                if (column) {
+                                    column->getPresence(block.begin,
+                                                        block.end,
+                                                        present.data());
+                                }
+                                else std::fill(present.begin(),
+                                               present.end(), 0);
+
+                                bool wantNull = c.op == "IS NULL";
+                                for (size_t w = 0;  w < numWords;  ++w) {
+                                    mask[w] &= wantNull
+                                        ? ~present[w] : present[w];
+                                }
+                            }
+                        }
+
+                        auto getRow = [&] (uint32_t i)
+                        {
+                            MatrixNamedRow row;
+                            row.rowName = chunk.getRowPath(i);
+                            row.rowHash = row.rowName;
+                            if (isProjected) {
+                                row.columns = chunk.getRowColumns(i, projected);
+                            }
+                            else if (needsColumns) {
+                                row.columns = chunk.getRow
+                                    (i, state->owner->fixedColumns);
+                            }
+                            return row;
+                        };
+
+                        auto passesMask = [&] (uint32_t i)
+                        {
+                            size_t bit = i - block.begin;
+                            return mask.empty()
+                                || ((mask[bit / 64] >> (bit % 64)) & 1);
+                        };
+
+                        if (batchMode) {
+                            rowCount += block.end - block.begin;
+                            if (onProgress) {
+                                whereProgress = rowCount;
+                                if (!onProgress(whereProgress))
+                                    return false;
+                            }
+
+                            ChunkBlockBatch batch(*state, chunk,
+                                                  block.begin, block.end);
+                            batch.onRow = [&] (const BoundSqlExpression & expr,
+                                               uint32_t i)
+                                {
+                                    MatrixNamedRow row = getRow(i);
+                                    auto rowScope
+                                        = dsScope->getRowScope(row, &params);
+                                    return expr(rowScope, GET_LATEST);
+                                };
+
+                            SqlSelection selection;
+                            selection.reserve(block.end - block.begin);
+                            for (uint32_t i = block.begin;  i < block.end;  ++i) {
+                                if (passesMask(i))
+                                    selection.push_back(i - block.begin);
+                            }
+
+                            for (uint32_t i: filterBatch(whereBound, batch,
+                                                         selection)) {
+                                blockOutput[n].emplace_back
+                                    (chunk.getRowPath(block.begin + i));
+                            }
+                            return true;
+                        }
+
+                        for (size_t i = block.begin;  i < block.end;  ++i) {
+                            if (++rowCount % PROGRESS_RATE == 0 && onProgress) {
+                                whereProgress = rowCount;
+                                if (!onProgress(whereProgress))
+                                    return false;
+                            }
+
+                            if (!passesMask(i))
+                                continue;
+
+                            MatrixNamedRow row = getRow(i);
+                            auto rowScope = dsScope->getRowScope(row, &params);
+                            if (whereBound(rowScope, GET_LATEST).isTrue())
+                                blockOutput[n].emplace_back(std::move(row.rowName));
+                        }
+                        return true;
+                    };
+
+                    // Use the same parallelism threshold and output order
+                    // as the full scan, so results don't depend on whether
+                    // chunks were pruned.
+                    bool parallel = state->rowCount >= 1000;
+                    if (parallel) {
+                        if (!parallelMapHaltable(0, blocks.size(), onBlock))
+                            throw CancellationException("row where generation was cancelled");
+                    }
+                    else {
+                        for (size_t i = 0;  i < blocks.size();  ++i)
+                            if (!onBlock(i))
+                                throw CancellationException("row where generation was cancelled");
+                    }
+
+                    std::vector<RowPath> rowsToKeep;
+                    for (auto & output: blockOutput) {
+                        rowsToKeep.insert(rowsToKeep.end(),
+                                          std::make_move_iterator(output.begin()),
+                                          std::make_move_iterator(output.end()));
+                    }
+
+                    if (parallel)
+                        parallelQuickSortRecursive<RowPath, SortByRowHash>
+                            (rowsToKeep.begin(), rowsToKeep.end());
+
+                    return { std::move(rowsToKeep), Any() };
+                },
+                explain};
+        }
+
         void serialize(StructuredSerializer & serializer) const
         {
             // Chunks first.  This allows us to rewrite the indexes if
             // new chunks are added.
 
+            // Chunks are independent, so they're serialized in parallel;
+            // the serializer writes their entries concurrently.
             {
                 auto chunkSerializer
                     = serializer.newStructure("ch");
 
-                for (size_t i = 0;  i < chunks.size();  ++i) {
-                    chunks[i]->serialize
-                        (*chunkSerializer->newStructure(to_string(i)));
-                }
+                auto onChunk = [&] (size_t i)
+                    {
+                        chunks[i]->serialize
+                            (*chunkSerializer->newStructure(to_string(i)));
+                    };
+
+                parallelMap(0, chunks.size(), onChunk);
                 chunkSerializer->commit();
             }
 
@@ -953,14 +1298,57 @@ struct TabularDataset::TabularDataStore
 
             rowIndex.serialize(*serializer.newStructure("ri"));
 
-            {
-                auto colSerializer = serializer.newEntry("cs");
-                
+            TabularDatasetStateMetadata md;
+            md.fixedColumns = owner->fixedColumns;
+            md.numChunks = chunks.size();
+            md.rowCount = rowCount;
+            if (rowCount != 0) {
+                md.earliestTs = earliestTs;
+                md.latestTs = latestTs;
             }
+            serializer.newObject("md.json", md);
+        }
 
-            {
-                auto mdSerializer = serializer.newStream("md");
-                mdSerializer << earliestTs << latestTs;
+        /** Reconstitute the state from what serialize() wrote.  The chunks
+            and row index are mapped from the reconstituter, so nothing
+            needs to be frozen or indexed again.
+        */
+        void reconstitute(StructuredReconstituter & reconstituter,
+                          const TabularDatasetStateMetadata & md)
+        {
+            auto chunkReconstituter = reconstituter.getStructure("ch");
+            std::vector<std::shared_ptr<const TabularDatasetChunk> >
+                loadedChunks(md.numChunks);
+
+            auto loadChunk = [&] (size_t i)
+                {
+                    loadedChunks[i] = std::make_shared<TabularDatasetChunk>
+                        (*chunkReconstituter->getStructure(i));
+                };
+
+            parallelMap(0, md.numChunks, loadChunk);
+
+            size_t totalRows = 0;
+            for (auto & c: loadedChunks) {
+                ExcAssertEqual(owner->fixedColumns.size(),
+                               c->fixedColumnCount());
+                totalRows += c->rowCount();
+            }
+
+            if (totalRows != md.rowCount) {
+                throw AnnotatedException
+                    (400, "Saved tabular dataset is inconsistent: it should "
+                     "have " + std::to_string(md.rowCount) + " rows but its "
+                     "chunks contain " + std::to_string(totalRows),
+                     "context", reconstituter.getContext());
+            }
+
+            chunks = std::move(loadedChunks);
+            rowCount = totalRows;
+            rowIndex.reconstitute(*reconstituter.getStructure("ri"));
+            if (rowCount != 0) {
+                earliestTs = md.earliestTs;
+                latestTs = md.latestTs;
             }
         }
     };
@@ -1144,6 +1532,84 @@ struct TabularDataset::TabularDataStore
             return extractT<CellValue>(numValues, columnNames, output);
         }
 
+        /** Decode rows [begin, end) of the column into out, in a typed
+            array if its values allow it.
+        */
+        static void readRange(const FrozenColumn & column,
+                              uint32_t begin, uint32_t end,
+                              SqlBatchVector & out)
+        {
+            size_t n = end - begin;
+            ColumnTypes types = column.getColumnTypes();
+
+            auto getNulls = [&] ()
+                {
+                    if (column.countNonNull(begin, end) == n)
+                        return;
+                    std::vector<uint64_t> present((n + 63) / 64);
+                    column.getPresence(begin, end, present.data());
+                    for (size_t i = 0;  i < n;  ++i) {
+                        if (!((present[i / 64] >> (i % 64)) & 1))
+                            out.setNull(i);
+                    }
+                };
+
+            if (types.onlyIntegersAndNulls()) {
+                out.initIntegers(n);
+                if (column.getRangeInt64(begin, end, out.ints.data(), 0)) {
+                    getNulls();
+                    return;
+                }
+            }
+
+            if (types.onlyDoublesAndNulls()) {
+                out.initDoubles(n);
+                if (column.getRangeDouble(begin, end, out.doubles.data())) {
+                    getNulls();
+                    return;
+                }
+            }
+
+            std::vector<CellValue> values(n);
+            column.getRange(begin, end, values.data());
+            out.initCells(std::move(values));
+        }
+
+        virtual void
+        extractColumnBatches(size_t numValues,
+                             const std::vector<ColumnPath> & columnNames,
+                             SqlBatchVector * output) override
+        {
+            std::vector<int> columnIndexes;
+            columnIndexes.reserve(columnNames.size());
+            for (size_t i = 0;  i < columnNames.size();  ++i) {
+                auto it = state->columnIndex.find(columnNames[i].oldHash());
+                columnIndexes.emplace_back(it == state->columnIndex.end()
+                                           ? -1 : it->second);
+                output[i].initAtoms(0);
+            }
+
+            // Each chunk is decoded a whole range at a time
+            SqlBatchVector segment;
+            for (size_t n = 0;  n < numValues;) {
+                size_t numRows = std::min(rowCount - rowIndex, numValues - n);
+                for (size_t i = 0;  i < columnNames.size();  ++i) {
+                    const FrozenColumn * column
+                        = (*chunkiter)->maybeGetColumn(columnIndexes[i],
+                                                       columnNames[i]);
+                    if (column)
+                        readRange(*column, rowIndex, rowIndex + numRows,
+                                  segment);
+                    else segment.initAtoms(numRows);
+                    output[i].append(segment);
+                }
+
+                n += numRows;
+                rowIndex += numRows - 1;
+                advance();  // moves on to the next chunk if needed
+            }
+        }
+
         std::shared_ptr<const CurrentState> state;
         std::vector<std::shared_ptr<const TabularDatasetChunk> >
             ::const_iterator chunkiter;
@@ -1212,9 +1678,18 @@ struct TabularDataset::TabularDataStore
     atomic_shared_ptr<ChunkList> mutableChunks;
 
     /// Holds the current state of everything.  Writing is protected
-    /// by the datasetMutex; reading is unprotected as it's constant
+    /// by the commitMutex; reading is unprotected as it's constant.  Each
+    /// commit builds the next state off to the side and publishes it
+    /// here atomically, so readers only ever see complete states and are
+    /// never blocked by a commit.
     atomic_shared_ptr<const CurrentState> currentState;
 
+    /// Serializes the building of new states (commit and restoring
+    /// checkpoints).  This is separate from the datasetMutex so that
+    /// chunks can continue to be frozen while a commit builds the
+    /// next state.
+    std::mutex commitMutex;
+
     /// Everything below here is protected by the dataset lock
     /// Mutex to make changes in the current state
     std::mutex datasetMutex;
@@ -1224,17 +1699,67 @@ struct TabularDataset::TabularDataStore
     /// immutable afterwards.
     std::vector<ColumnPath> fixedColumns;
 
-    /// Index of just the fixed columns, to look them up by hash
-    LightweightHash<uint64_t, int> fixedColumnIndex;
+    /// Index of just the fixed columns, to find their position
+    PathPositionIndex fixedColumnIndex;
 
     /// All chunks we've added but haven't yet committed
     std::vector<std::shared_ptr<TabularDatasetChunk> > frozenChunks;
 
-    /// Configuration passed in.  Constant after initialization.
-    TabularDatasetConfig config;
+    /// Row name hashes for each of frozenChunks, in the same order
+    std::vector<std::shared_ptr<MutablePathIndex::ChunkEntries> >
+        frozenChunkEntries;
+
+    /// Configuration passed in.  Constant after initialization.
+    TabularDatasetConfig config;
+
+    /// The number of background jobs that we're currently waiting for
+    std::atomic<size_t> backgroundJobsActive;
+
+    /// Signalled, under freezeMutex, each time a background job finishes
+    std::mutex freezeMutex;
+    std::condition_variable freezeFinished;
+
+    /// Set when the dataset was loaded from its dataFileUrl, in which
+    /// case it can't be recorded to.
+    bool readOnly = false;
+
+    /// Serializes saveCheckpoint() and restoreCheckpoint()
+    std::mutex checkpointMutex;
+
+    /// Number of committed chunks that checkpoints have saved
+    size_t checkpointedChunks = 0;
+
+    /// Freeze statistics, which are reported in the status
+    std::atomic<uint64_t> chunksFrozen{0};
+    std::atomic<uint64_t> rowsFrozen{0};
+    std::atomic<uint64_t> freezeMicroseconds{0};
+
+    /// Estimated bytes per row of the last chunk frozen, used to size
+    /// new chunks.  Zero until a chunk has been frozen.
+    std::atomic<size_t> lastBytesPerRow{0};
+
+    /// How long the last commit took, and how much of it was spent on
+    /// the row index
+    std::atomic<double> lastCommitSeconds{0.0};
+    std::atomic<double> lastRowIndexSeconds{0.0};
+
+    /// The file the dataset was loaded from, if it was, which is where
+    /// warmup() finds the regions to read in
+    std::shared_ptr<const StructuredReconstituter> loadedFrom;
+
+    /// Protects the warmup state and thread below.  The byte counts are
+    /// updated by the warmup without it.
+    mutable std::mutex warmupMutex;
+    std::thread warmupThread;
+    std::string warmupState = "none";
+    std::string warmupError;
+    Date warmupStarted;
+    Date warmupFinished;
+    std::atomic<uint64_t> warmupBytesTotal{0};
+    std::atomic<uint64_t> warmupBytesDone{0};
 
-    /// The number of background jobs that we're currently waiting for
-    std::atomic<size_t> backgroundJobsActive;
+    /// Set on destruction to stop background work
+    std::atomic<bool> shutdown{false};
 
     /// Logger instance for this class
     shared_ptr<spdlog::logger> logger;
@@ -1352,6 +1877,23 @@ struct TabularDataset::TabularDataStore
             ->generateRowsWhere(context, alias, where, offset, limit);
     }
 
+    virtual std::function<ExpressionValue (const RowPath & row)>
+    getRowExprProjection(const UnboundEntities & unbound,
+                         const Utf8String & alias) const
+    {
+        return currentState.load()->getRowExprProjection(unbound, alias);
+    }
+
+    GenerateRowsWhereFunction
+    generateChunkScan(const Dataset & dataset,
+                      const Utf8String & alias,
+                      const SqlExpression & where,
+                      GenerateRowsWhereFunction fullScan) const
+    {
+        return currentState.load()
+            ->generateChunkScan(dataset, alias, where, std::move(fullScan));
+    }
+
     void initRoutes()
     {
         addRouteSyncJsonReturn(router, "/saves", {"POST"},
@@ -1360,6 +1902,17 @@ struct TabularDataset::TabularDataStore
                                &TabularDataStore::save,
                                this,
                                JsonParam<Url>("dataFileUrl", "URI of artifact to save under"));
+
+        addRouteSyncJsonReturn(router, "/warmup", {"POST"},
+                               "Read the index structures and the given "
+                               "columns of a dataset loaded from its "
+                               "dataFileUrl into memory in the background",
+                               "Progress of the warmup",
+                               &TabularDataStore::warmup,
+                               this,
+                               JsonParamDefault<std::vector<ColumnPath> >
+                                   ("columns", "Columns whose values are also "
+                                    "read in", std::vector<ColumnPath>()));
     }
 
     virtual RestRequestMatchResult
@@ -1370,17 +1923,87 @@ struct TabularDataset::TabularDataStore
         return router.processRequest(connection, request, context);
     }
 
+    /// Add the columns of the chunks of the state from firstChunk onwards
+    /// to its column index.
+    void indexColumns(CurrentState & state, size_t firstChunk) const
+    {
+        // This will only happen when this is the first commit
+        if (state.columns.empty()) {
+            state.columns.reserve(fixedColumns.size());
+            for (size_t i = 0;  i < fixedColumns.size();  ++i) {
+                const ColumnPath & c = fixedColumns[i];
+                ColumnEntry entry;
+                entry.columnName = c;
+                state.columns.emplace_back(entry);
+                state.columnIndex[c.oldHash()] = i;
+                state.columnHashIndex[c] = i;
+            }
+        }
+
+        // Create the column index.  This should be rapid, as there shouldn't
+        // be too many columns.
+        for (size_t i = firstChunk;  i < state.chunks.size();  ++i) {
+            const TabularDatasetChunk & chunk = *state.chunks[i];
+            ExcAssertEqual(fixedColumns.size(), chunk.fixedColumnCount());
+            for (size_t j = 0;  j < chunk.columns.size();  ++j) {
+                state.columns[j].chunks.emplace_back(i, chunk.columns[j]);
+                state.columns[j].nonNullRowCount
+                    += chunk.columns[j]->nonNullRowCount();
+            }
+            auto addSparseColumn = [&] (const ColumnPath & columnName,
+                                        std::shared_ptr<FrozenColumn> column)
+                {
+                    auto it = state.columnIndex
+                        .insert(make_pair(columnName.oldHash(),
+                                          state.columns.size()))
+                        .first;
+                    if (it->second == state.columns.size()) {
+                        ColumnEntry entry;
+                        entry.columnName = columnName;
+                        state.columns.emplace_back(entry);
+                        state.columnHashIndex[columnName] = it->second;
+                    }
+                    state.columns[it->second].nonNullRowCount
+                        += column->nonNullRowCount();
+                    state.columns[it->second].chunks
+                        .emplace_back(i, std::move(column));
+                };
+
+            for (auto & c: chunk.sparseColumns)
+                addSparseColumn(c.first, c.second);
+            for (auto & c: chunk.remainderColumns)
+                addSparseColumn(c.first, c.second);
+        }
+        
+        ExcAssertEqual(state.columns.size(), state.columnIndex.size());
+        ExcAssertEqual(state.columns.size(),
+                       state.columnHashIndex.size());
+    }
+
+    /// Hash the row names of the chunk for the row index
+    static void hashRowNames(const TabularDatasetChunk & chunk,
+                             MutablePathIndex::ChunkEntries & entries)
+    {
+        for (unsigned i = 0;  i < chunk.rowCount();  ++i) {
+            RowPath rowNameStorage;
+            entries.record(chunk.getRowPath(i, rowNameStorage), i);
+        }
+    }
+
     /// Create a new current state from the old one plus the extra
     /// chunks.
     std::shared_ptr<CurrentState>
     finalize(std::shared_ptr<const CurrentState> oldState,
-             std::vector<std::shared_ptr<TabularDatasetChunk> > & inputChunks)
+             std::vector<std::shared_ptr<TabularDatasetChunk> > & inputChunks,
+             std::vector<std::shared_ptr<MutablePathIndex::ChunkEntries> >
+                 & inputEntries)
     {
-        // NOTE: must be called with the lock held
+        // NOTE: must be called with the commitMutex held.  Nothing here
+        // is visible to readers until the returned state is published.
 
         size_t totalRows = oldState->rowCount;
 
-        cerr << "commiting " << frozenChunks.size() << " frozen chunks"
+        cerr << "commiting " << inputChunks.size() << " frozen chunks"
              << endl;
 
         for (auto & c: inputChunks) {
@@ -1390,6 +2013,7 @@ struct TabularDataset::TabularDataStore
         auto newState = std::make_shared<CurrentState>(*oldState);
 
         newState->rowCount = totalRows;
+        newState->version = oldState->version + 1;
         
         size_t numChunksBefore = newState->chunks.size();
         
@@ -1402,84 +2026,47 @@ struct TabularDataset::TabularDataStore
         // Make sure they aren't reused
         inputChunks.clear();
 
-        // This will only happen when this is the first commit
-        if (newState->columns.empty()) {
-            newState->columns.reserve(fixedColumns.size());
-            for (size_t i = 0;  i < fixedColumns.size();  ++i) {
-                const ColumnPath & c = fixedColumns[i];
-                ColumnEntry entry;
-                entry.columnName = c;
-                newState->columns.emplace_back(entry);
-                newState->columnIndex[c.oldHash()] = i;
-                newState->columnHashIndex[c] = i;
-            }
-        }
-
-        // Create the column index.  This should be rapid, as there shouldn't
-        // be too many columns.
-        for (size_t i = numChunksBefore;  i < newState->chunks.size();  ++i) {
-            const TabularDatasetChunk & chunk = *newState->chunks[i];
-            ExcAssertEqual(fixedColumns.size(), chunk.fixedColumnCount());
-            for (size_t j = 0;  j < chunk.columns.size();  ++j) {
-                newState->columns[j].chunks.emplace_back(i, chunk.columns[j]);
-                newState->columns[j].nonNullRowCount
-                    += chunk.columns[j]->nonNullRowCount();
-            }
-            for (auto & c: chunk.sparseColumns) {
-                auto it = newState->columnIndex
-                    .insert(make_pair(c.first.oldHash(),
-                                      newState->columns.size()))
-                    .first;
-                if (it->second == newState->columns.size()) {
-                    ColumnEntry entry;
-                    entry.columnName = c.first;
-                    newState->columns.emplace_back(entry);
-                    newState->columnHashIndex[c.first] = it->second;
-                }
-                newState->columns[it->second].chunks.emplace_back(i, c.second);
-                newState->columns[it->second].nonNullRowCount
-                    += c.second->nonNullRowCount();
-            }
-        }
-        
-        ExcAssertEqual(newState->columns.size(), newState->columnIndex.size());
-        ExcAssertEqual(newState->columns.size(),
-                       newState->columnHashIndex.size());
+        indexColumns(*newState, numChunksBefore);
 
-        
-        // Recreate the index if a new chunk has been added
+        // Add the new chunks to the row index.  Their row names were
+        // hashed when they were frozen, so only the rows of the index
+        // layers that they're merged with need to be hashed again.  The
+        // index is part of the new state, so if anything fails it is
+        // simply never published.
         if (numChunksBefore != newState->chunks.size()) {
-            MutablePathIndex index;
+            Timer rowIndexTimer;
 
-            // We create the row index in multiple chunks
+            ExcAssertEqual(inputEntries.size(),
+                           newState->chunks.size() - numChunksBefore);
+            std::vector<const MutablePathIndex::ChunkEntries *> entries;
+            for (auto & e: inputEntries)
+                entries.push_back(e.get());
 
-            Timer rowIndexTimer;
+            PathIndexParameters rowIndexParams;
+            rowIndexParams.bloomFilter = config.rowIndexBloomFilter;
+            rowIndexParams.perfectHash = config.rowIndexPerfectHash;
+
+            const auto & chunks = newState->chunks;
 
-            auto indexChunk = [&] (int chunkNum)
+            auto getChunkEntries = [&] (uint32_t chunkNumber,
+                                        MutablePathIndex::ChunkEntries & e)
                 {
-                    auto recorder = index.getRecorder(chunkNum);
-                    for (unsigned j = 0;
-                         j < newState->chunks[chunkNum]->rowCount();
-                         ++j) {
-                        RowPath rowNameStorage;
-                        const RowPath & rowName
-                            = newState->chunks[chunkNum]
-                            ->getRowPath(j, rowNameStorage);
-                        recorder.record(rowName, j);
-                    }
-                
-                    recorder.commit();
+                    hashRowNames(*chunks.at(chunkNumber), e);
+                };
+
+            auto getRowHash = [&] (uint32_t chunkNumber,
+                                   uint32_t indexInChunk)
+                {
+                    RowPath storage;
+                    return chunks.at(chunkNumber)
+                        ->getRowPath(indexInChunk, storage).hash();
                 };
-        
-            // NOTE: we currently re-index everything from the
-            // previous chunks; this is a big scalability problem.
-            // We should not do that once multiple commits become
-            // an important use case
-            parallelMap(0, newState->chunks.size(), indexChunk);
 
-            std::vector<std::tuple<int, int, int, int> > possibleCollisions;
-            std::tie(newState->rowIndex, possibleCollisions)
-                = index.freeze(serializer);
+            std::vector<std::tuple<int, int, int, int> > possibleCollisions
+                = newState->rowIndex.add(serializer, numChunksBefore,
+                                         entries, getChunkEntries,
+                                         getRowHash, rowIndexParams);
+            inputEntries.clear();
 
             cerr << possibleCollisions.size() << " possible collisions"
                  << endl;
@@ -1520,6 +2107,7 @@ struct TabularDataset::TabularDataStore
             
             cerr << "rowIndex.memusage() = " << newState->rowIndex.memusage()
                  << endl;
+            lastRowIndexSeconds = rowIndexTimer.elapsed_wall();
             INFO_MSG(logger) << "row index took " << rowIndexTimer.elapsed();
         }
 
@@ -1532,8 +2120,7 @@ struct TabularDataset::TabularDataStore
         this->fixedColumns = std::move(columnNames);
 
         for (size_t i = 0;  i < fixedColumns.size();  ++i) {
-            if (!fixedColumnIndex.insert(make_pair(fixedColumns[i].oldHash(), i))
-                .second)
+            if (!fixedColumnIndex.add(fixedColumns[i]))
                 throw AnnotatedException(500,
                                           "Duplicate column name in tabular dataset",
                                           "columnName", fixedColumns[i]);
@@ -1546,6 +2133,235 @@ struct TabularDataset::TabularDataStore
         cs->serialize(serializer);
     }
 
+    /** Load the dataset from a file written by save().  The file is
+        memory mapped, and the chunks and row index are used in place so
+        nothing is frozen or indexed again; the pages are only read in
+        when they are accessed.
+    */
+    void load(const Url & dataFileUrl)
+    {
+        Timer timer;
+
+        auto reconstitutedFrom
+            = std::make_shared<ZipStructuredReconstituter>(dataFileUrl);
+        ZipStructuredReconstituter & reconstituter = *reconstitutedFrom;
+
+        TabularDatasetStateMetadata md;
+        reconstituter.getObject("md.json", md);
+
+        if (md.version != TabularDatasetStateMetadata().version) {
+            throw AnnotatedException
+                (400, "Tabular dataset file " + dataFileUrl.toString()
+                 + " has unsupported version " + std::to_string(md.version));
+        }
+
+        std::unique_lock<std::mutex> guard(datasetMutex);
+
+        initialize(md.fixedColumns);
+
+        auto newState = std::make_shared<CurrentState>(this, logger);
+        newState->reconstitute(reconstituter, md);
+        indexColumns(*newState, 0);
+
+        currentState.store(std::move(newState));
+        readOnly = true;
+        loadedFrom = std::move(reconstitutedFrom);
+
+        INFO_MSG(logger) << "loaded " << md.rowCount << " rows in "
+                         << md.numChunks << " chunks from " << dataFileUrl.toString()
+                         << " in " << timer.elapsed();
+    }
+
+    /// Throw if the dataset can't be recorded to
+    void checkWritable() const
+    {
+        if (readOnly) {
+            throw AnnotatedException
+                (400, "Tabular dataset loaded from "
+                 + config.dataFileUrl.toString()
+                 + " is read-only and can't be recorded to");
+        }
+    }
+
+    /** Find the mapped regions that warmup() reads in: the row index,
+        the row names, timestamps and zone maps of each chunk and the
+        values of the given columns.  Large regions are split so that
+        they can be read in in parallel.
+    */
+    std::vector<FrozenMemoryRegion>
+    getWarmupRegions(const std::vector<ColumnPath> & columns) const
+    {
+        static constexpr size_t MAX_REGION_BYTES = 16 << 20;
+
+        std::vector<FrozenMemoryRegion> result;
+
+        auto addRegion = [&] (const FrozenMemoryRegion & region)
+            {
+                for (size_t i = 0;  i < region.length();
+                     i += MAX_REGION_BYTES) {
+                    result.emplace_back
+                        (region.range(i, std::min(region.length(),
+                                                  i + MAX_REGION_BYTES)));
+                }
+            };
+
+        std::function<void (const StructuredReconstituter &)> addAll
+            = [&] (const StructuredReconstituter & reconstituter)
+            {
+                for (auto & entry: reconstituter.getDirectory()) {
+                    if (entry.getBlock)
+                        addRegion(entry.getBlock());
+                    if (entry.getStructure)
+                        addAll(*entry.getStructure());
+                }
+            };
+
+        // Entries of each chunk to read in.  Fixed columns are stored
+        // under their number, and the others (by name) under "sp" or in
+        // the sparse remainder.
+        std::set<Utf8String> chunkEntries = { "rn", "ts", "zm" };
+        std::set<Utf8String> sparseEntries;
+        for (auto & c: columns) {
+            int index = fixedColumnIndex.find(c);
+            if (index >= 0) {
+                chunkEntries.insert(std::to_string(index));
+            }
+            else {
+                sparseEntries.insert(c.toUtf8String());
+                chunkEntries.insert("rm");
+            }
+        }
+
+        addAll(*loadedFrom->getStructure("ri"));
+
+        for (auto & chunk: loadedFrom->getStructure("ch")->getDirectory()) {
+            if (!chunk.getStructure)
+                continue;
+            for (auto & entry: chunk.getStructure()->getDirectory()) {
+                Utf8String name = entry.name.toUtf8String();
+                if (name == "sp" && entry.getStructure
+                    && !sparseEntries.empty()) {
+                    for (auto & sp: entry.getStructure()->getDirectory()) {
+                        if (!sparseEntries.count(sp.name.toUtf8String()))
+                            continue;
+                        if (sp.getBlock)
+                            addRegion(sp.getBlock());
+                        if (sp.getStructure)
+                            addAll(*sp.getStructure());
+                    }
+                }
+                else if (chunkEntries.count(name)) {
+                    if (entry.getBlock)
+                        addRegion(entry.getBlock());
+                    if (entry.getStructure)
+                        addAll(*entry.getStructure());
+                }
+            }
+        }
+
+        return result;
+    }
+
+    /** Start reading in the index structures and the given columns of a
+        dataset that was loaded from its dataFileUrl, so that the first
+        queries after a restart don't have to wait for them to be paged
+        in.  This returns straight away; progress is reported in the
+        status.  If a warmup is already running, it continues and this
+        does nothing.
+    */
+    Json::Value warmup(std::vector<ColumnPath> columns)
+    {
+        if (!loadedFrom) {
+            throw AnnotatedException
+                (400, "Only tabular datasets that were loaded from their "
+                 "dataFileUrl can be warmed up");
+        }
+
+        std::unique_lock<std::mutex> guard(warmupMutex);
+
+        if (warmupState != "running") {
+            if (warmupThread.joinable())
+                warmupThread.join();
+
+            auto regions = getWarmupRegions(columns);
+
+            uint64_t totalBytes = 0;
+            for (auto & r: regions)
+                totalBytes += r.length();
+
+            warmupBytesTotal = totalBytes;
+            warmupBytesDone = 0;
+            warmupState = "running";
+            warmupError.clear();
+            warmupStarted = Date::now();
+
+            warmupThread = std::thread([this, regions = std::move(regions)] ()
+                                       {
+                                           runWarmup(regions);
+                                       });
+        }
+
+        return getWarmupStatusLocked();
+    }
+
+    void runWarmup(const std::vector<FrozenMemoryRegion> & regions)
+    {
+        std::string error;
+
+        try {
+            // Let the kernel start reading everything in...
+            for (auto & r: regions) {
+                if (shutdown)
+                    break;
+                r.adviseWillNeed();
+            }
+
+            // ... and make sure it's there
+            auto onRegion = [&] (size_t i)
+                {
+                    if (shutdown)
+                        return;
+                    warmupBytesDone += regions[i].prefetch();
+                };
+
+            parallelMap(0, regions.size(), onRegion);
+        } MLDB_CATCH_ALL {
+            error = getExceptionString();
+            ERROR_MSG(logger) << "error warming up tabular dataset: "
+                              << error;
+        }
+
+        std::unique_lock<std::mutex> guard(warmupMutex);
+        warmupFinished = Date::now();
+        warmupError = error;
+        if (!error.empty())
+            warmupState = "error";
+        else if (shutdown)
+            warmupState = "cancelled";
+        else warmupState = "finished";
+
+        INFO_MSG(logger) << "warmup " << warmupState << " after reading "
+                         << warmupBytesDone << " bytes in "
+                         << warmupFinished.secondsSince(warmupStarted)
+                         << " seconds";
+    }
+
+    Json::Value getWarmupStatusLocked() const
+    {
+        Json::Value result;
+        result["state"] = warmupState;
+        if (warmupState == "none")
+            return result;
+        result["bytesTotal"] = warmupBytesTotal.load();
+        result["bytesDone"] = warmupBytesDone.load();
+        result["seconds"]
+            = (warmupState == "running" ? Date::now() : warmupFinished)
+            .secondsSince(warmupStarted);
+        if (!warmupError.empty())
+            result["error"] = warmupError;
+        return result;
+    }
+
     PolyConfigT<Dataset> save(Url dataFileUrl) const
     {
         MLDB::makeUriDirectory(dataFileUrl.toString());
@@ -1564,6 +2380,123 @@ struct TabularDataset::TabularDataStore
         return result;
     }
 
+    /** Save the chunks committed since the last checkpoint.  The file has
+        the same layout as one written by save(), apart from the row index,
+        which is rebuilt from the row names when it's restored.
+    */
+    uint64_t saveCheckpoint(const Url & dataFileUrl)
+    {
+        checkWritable();
+        commit();
+
+        // Checkpoints are taken one at a time
+        std::unique_lock<std::mutex> guard(checkpointMutex);
+
+        auto state = currentState.load();
+
+        MLDB::makeUriDirectory(dataFileUrl.toString());
+        ZipStructuredSerializer serializer(dataFileUrl.toUtf8String());
+
+        uint64_t rowCount = 0;
+        auto chunkSerializer = serializer.newStructure("ch");
+        auto onChunk = [&] (size_t i)
+            {
+                state->chunks[i]->serialize
+                    (*chunkSerializer->newStructure
+                         (to_string(i - checkpointedChunks)));
+            };
+        parallelMap(checkpointedChunks, state->chunks.size(), onChunk);
+        for (size_t i = checkpointedChunks;  i < state->chunks.size();  ++i)
+            rowCount += state->chunks[i]->rowCount();
+        chunkSerializer->commit();
+
+        TabularDatasetStateMetadata md;
+        md.fixedColumns = fixedColumns;
+        md.numChunks = state->chunks.size() - checkpointedChunks;
+        md.rowCount = rowCount;
+        serializer.newObject("md.json", md);
+
+        checkpointedChunks = state->chunks.size();
+
+        return rowCount;
+    }
+
+    /** Add the chunks of the checkpoints to the dataset, which must be
+        empty.  The chunks are memory mapped as for load(), but their row
+        names are hashed so that the dataset can be recorded to and
+        committed afterwards.
+    */
+    void restoreCheckpoint(const std::vector<Url> & dataFileUrls)
+    {
+        checkWritable();
+
+        std::unique_lock<std::mutex> checkpointGuard(checkpointMutex);
+        std::unique_lock<std::mutex> commitGuard(commitMutex);
+        std::unique_lock<std::mutex> guard(datasetMutex);
+
+        auto oldState = currentState.load();
+        if (mutableChunks.load() || oldState->rowCount != 0
+            || !frozenChunks.empty()) {
+            throw AnnotatedException
+                (400, "Tabular dataset checkpoints can only be restored into "
+                 "an empty dataset");
+        }
+
+        // Don't leave half of the checkpoints waiting to be committed
+        Scope_Failure(frozenChunks.clear());
+        Scope_Failure(frozenChunkEntries.clear());
+
+        for (auto & url: dataFileUrls) {
+            ZipStructuredReconstituter reconstituter(url);
+
+            TabularDatasetStateMetadata md;
+            reconstituter.getObject("md.json", md);
+
+            if (md.version != TabularDatasetStateMetadata().version) {
+                throw AnnotatedException
+                    (400, "Tabular dataset checkpoint " + url.toString()
+                     + " has unsupported version "
+                     + std::to_string(md.version));
+            }
+
+            // Nothing was committed before it was taken
+            if (md.numChunks == 0)
+                continue;
+
+            if (!mutableChunks.load())
+                createMutableChunks(md.fixedColumns);
+            else if (md.fixedColumns != fixedColumns) {
+                throw AnnotatedException
+                    (400, "Tabular dataset checkpoint " + url.toString()
+                     + " has different columns to the ones before it",
+                     "columns", md.fixedColumns,
+                     "expectedColumns", fixedColumns);
+            }
+
+            auto chunkReconstituter = reconstituter.getStructure("ch");
+            size_t first = frozenChunks.size();
+            frozenChunks.resize(first + md.numChunks);
+            frozenChunkEntries.resize(first + md.numChunks);
+
+            auto loadChunk = [&] (size_t i)
+                {
+                    auto chunk = std::make_shared<TabularDatasetChunk>
+                        (*chunkReconstituter->getStructure(i));
+                    auto entries
+                        = std::make_shared<MutablePathIndex::ChunkEntries>();
+                    hashRowNames(*chunk, *entries);
+                    frozenChunks[first + i] = std::move(chunk);
+                    frozenChunkEntries[first + i] = std::move(entries);
+                };
+
+            parallelMap(0, md.numChunks, loadChunk);
+        }
+
+        auto newState = finalize(oldState, frozenChunks, frozenChunkEntries);
+        checkpointedChunks = newState->chunks.size();
+        currentState.store(std::move(newState));
+    }
+
     /** This is a recorder that allows parallel records from multiple
         threads. */
     struct BasicRecorder: public Recorder {
@@ -1729,10 +2662,7 @@ struct TabularDataset::TabularDataStore
                 ExcAssertEqual(written,
                                MutableTabularDatasetChunk::ADD_PERFORM_ROTATION);
                 finishedChunk();
-                chunk.reset
-                    (new MutableTabularDatasetChunk
-                     (orderedVals.size(),
-                      chunkSizeForNumColumns(orderedVals.size())));
+                chunk = store->newMutableChunk(orderedVals.size());
             }
         }
 
@@ -1770,9 +2700,7 @@ struct TabularDataset::TabularDataStore
         {
             if (!chunk || chunk->rowCount() == 0)
                 return;
-            ColumnFreezeParameters params;
-            auto frozen = chunk->freeze(store->serializer, params);
-            store->addFrozenChunk(std::move(frozen));
+            store->freezeChunkInBackground(std::move(chunk));
         }
 
         virtual
@@ -1821,10 +2749,7 @@ struct TabularDataset::TabularDataStore
                         ExcAssertEqual(written,
                                        MutableTabularDatasetChunk::ADD_PERFORM_ROTATION);
                         finishedChunk();
-                        chunk.reset
-                            (new MutableTabularDatasetChunk
-                             (columnNames.size(),
-                              chunkSizeForNumColumns(columnNames.size())));
+                        chunk = store->newMutableChunk(columnNames.size());
                     }
                 };
         }
@@ -1832,12 +2757,17 @@ struct TabularDataset::TabularDataStore
 
     void commit()
     {
+        // Nothing can have been recorded to a loaded dataset
+        if (readOnly)
+            return;
+
+        Timer commitTimer;
+
         // Create new chunks to hold any new data that comes in
         auto newChunks = std::make_shared<ChunkList>(NUM_PARALLEL_CHUNKS);
 
         for (auto & c: *newChunks) {
-            auto newChunk = std::make_shared<MutableTabularDatasetChunk>
-                (fixedColumns.size(), chunkSizeForNumColumns(fixedColumns.size()));
+            auto newChunk = newMutableChunk(fixedColumns.size());
             c.store(std::move(newChunk));
         }
             
@@ -1860,29 +2790,33 @@ struct TabularDataset::TabularDataStore
             c.store(nullptr);
         }
 
-        // Wait for the background freeze events to finish.  We do it by
-        // busy waiting while working in between, to ensure that we don't
-        // deadlock if there are no other threads available to do the
-        // work.
-        while (backgroundJobsActive)
-            ThreadPool::instance().work();
+        // Wait for the background freeze events to finish
+        waitForBackgroundFreezes(0);
 
-        // We can only take the mutex here, as the background threads need
-        // to access it.
-        std::unique_lock<std::mutex> guard(datasetMutex);
+        // Now we have this lock, nobody else can come along and modify
+        // the current state.  Others may still read it while we're
+        // working, but it will not change.
+        std::unique_lock<std::mutex> commitGuard(commitMutex);
 
-        // Now we have a lock, we now that nobody else can come along and
-        // modify anything.  First, grab the current state.  Others may
-        // still access this state to read while we're working, but it
-        // will not change as we have the lock.
-        auto oldState = currentState.load();
+        // Take the chunks that are ready to be committed.  The dataset
+        // mutex is only held for this, so that chunks being recorded now
+        // can be frozen while we build the next state.
+        std::vector<std::shared_ptr<TabularDatasetChunk> > chunks;
+        std::vector<std::shared_ptr<MutablePathIndex::ChunkEntries> > entries;
+        {
+            std::unique_lock<std::mutex> guard(datasetMutex);
+            chunks.swap(frozenChunks);
+            entries.swap(frozenChunkEntries);
+        }
 
-        // At this point, nobody can see oldMutableChunks or its contents
-        // apart from this thread.  So we can perform operations unlocked
-        // on it without any problem.
+        auto oldState = currentState.load();
 
-        auto newState = finalize(oldState, frozenChunks);
+        // Build the next state off to the side.  Existing chunks are
+        // shared with the old state, and only the new ones are indexed.
+        auto newState = finalize(oldState, chunks, entries);
 
+        // Publish it.  Readers that already have the old state continue
+        // to use it until they're done.
         currentState.store(newState);
         
         uint64_t totalRows = newState->rowCount;
@@ -1933,6 +2867,11 @@ struct TabularDataset::TabularDataStore
                          << 1.0 * mem / totalRows << " bytes/row";
         INFO_MSG(logger) << "column memory is " << columnMem;
 
+        lastCommitSeconds = commitTimer.elapsed_wall();
+        INFO_MSG(logger) << "commit took " << commitTimer.elapsed();
+
+        if (!config.dataFileUrl.empty())
+            save(config.dataFileUrl);
     }
 
     // freezes a new chunk in the background, and adds it to frozenChunks.
@@ -1943,29 +2882,124 @@ struct TabularDataset::TabularDataStore
         if (chunk->rowCount() == 0)
             return;
 
-        ColumnFreezeParameters params;
+        // Bound the number of chunks waiting to be frozen, so that fast
+        // recorders can't get too far ahead and hold on to an unlimited
+        // amount of unfrozen data.
+        waitForBackgroundFreezes(maxBackgroundFreezes() - 1);
+
         auto job = [=] ()
             {
-                Scope_Exit(--this->backgroundJobsActive);
-                auto frozen = chunk->freeze(serializer, params);
-                addFrozenChunk(std::move(frozen));
+                Scope_Exit(this->finishBackgroundFreeze());
+                freezeChunk(*chunk);
             };
         
         ++backgroundJobsActive;
         try {
             ThreadPool::instance().add(std::move(job));
         } catch (...) {
-            --backgroundJobsActive;
+            finishBackgroundFreeze();
             throw;
         }
     }
 
-    void addFrozenChunk(TabularDatasetChunk frozen)
+    void finishBackgroundFreeze()
+    {
+        std::unique_lock<std::mutex> guard(freezeMutex);
+        --backgroundJobsActive;
+        freezeFinished.notify_all();
+    }
+
+    /** Wait until no more than maxActive background freezes are running.
+        While waiting we run jobs from the thread pool, so that this can't
+        deadlock when there are no other threads free to do them.  When
+        there's nothing we can run, the freezes are running elsewhere and
+        we sleep until one finishes.  The timeout covers jobs that were
+        queued while we were going to sleep.
+    */
+    void waitForBackgroundFreezes(size_t maxActive)
+    {
+        while (backgroundJobsActive > maxActive) {
+            if (ThreadPool::instance().work())
+                continue;
+            std::unique_lock<std::mutex> guard(freezeMutex);
+            freezeFinished.wait_for(guard, std::chrono::milliseconds(10),
+                                    [&] ()
+                                    {
+                                        return backgroundJobsActive
+                                            <= maxActive;
+                                    });
+        }
+    }
+
+    static size_t maxBackgroundFreezes()
+    {
+        return 2 * numCpus();
+    }
+
+    /** Freeze the chunk, hash its row names for the row index and add
+        them to the uncommitted chunks.  This is called from the
+        background freeze jobs.
+    */
+    void freezeChunk(MutableTabularDatasetChunk & chunk)
+    {
+        Timer timer;
+
+        // The next chunks are sized from this one
+        lastBytesPerRow = std::max<size_t>(1, chunk.bytesRecorded()
+                                           / std::max<size_t>(1, chunk.rowCount()));
+
+        ColumnFreezeParameters params;
+        auto frozen = chunk.freeze(serializer, params,
+                                   config.sparseRemainderFraction);
+
+        auto entries = std::make_shared<MutablePathIndex::ChunkEntries>();
+        hashRowNames(frozen, *entries);
+
+        chunksFrozen += 1;
+        rowsFrozen += frozen.rowCount();
+        freezeMicroseconds += timer.elapsed_wall() * 1000000;
+
+        addFrozenChunk(std::move(frozen), std::move(entries));
+    }
+
+    void addFrozenChunk(TabularDatasetChunk frozen,
+                        std::shared_ptr<MutablePathIndex::ChunkEntries> entries)
     {
         ExcAssertNotEqual(frozen.rowCount(), 0);
         std::unique_lock<std::mutex> guard(datasetMutex);
         frozenChunks.emplace_back
             (new TabularDatasetChunk(std::move(frozen)));
+        frozenChunkEntries.emplace_back(std::move(entries));
+    }
+
+    Any getStatus() const
+    {
+        auto state = currentState.load();
+        Json::Value status;
+        status["rowCount"] = state->rowCount;
+        status["columnCount"] = state->columns.size();
+        status["chunkCount"] = state->chunks.size();
+        status["version"] = state->version;
+
+        // Freeze throughput is measured per chunk, with several chunks
+        // frozen in parallel, so the rate is per freezing thread.
+        Json::Value & freeze = status["freeze"];
+        double freezeSeconds = freezeMicroseconds / 1000000.0;
+        freeze["chunksFrozen"] = chunksFrozen.load();
+        freeze["rowsFrozen"] = rowsFrozen.load();
+        freeze["freezeSeconds"] = freezeSeconds;
+        freeze["rowsPerSecondPerThread"]
+            = freezeSeconds == 0.0 ? 0.0 : rowsFrozen / freezeSeconds;
+        freeze["chunksWaiting"] = backgroundJobsActive.load();
+        freeze["lastCommitSeconds"] = lastCommitSeconds.load();
+        freeze["lastRowIndexSeconds"] = lastRowIndexSeconds.load();
+        freeze["rowIndexLayers"] = state->rowIndex.layers.size();
+        if (loadedFrom) {
+            std::unique_lock<std::mutex> guard(warmupMutex);
+            status["warmup"] = getWarmupStatusLocked();
+        }
+        status["memory"] = jsonEncode(serializer.getStats());
+        return status;
     }
     
     std::shared_ptr<MutableTabularDatasetChunk>
@@ -1976,11 +3010,10 @@ struct TabularDataset::TabularDataStore
         if (!mc)
             return nullptr;
 
+        if (expectedSize == -1)
+            return newMutableChunk(fixedColumns.size());
         return std::make_shared<MutableTabularDatasetChunk>
-            (fixedColumns.size(),
-             expectedSize == -1
-             ? chunkSizeForNumColumns(fixedColumns.size())
-             : expectedSize);
+            (fixedColumns.size(), expectedSize, config.chunkByteBudget);
     }
 
     /** Analyze the first row to know what the columns are. */
@@ -2002,19 +3035,25 @@ struct TabularDataset::TabularDataStore
                 columnNames.push_back(c);
             }
 
-            initialize(std::move(columnNames));
+            createMutableChunks(std::move(columnNames));
+        }
+    }
+
+    /// Set the fixed columns and create the chunks that rows are recorded
+    /// into.  Must be done with the dataset lock held.
+    void createMutableChunks(vector<ColumnPath> columnNames)
+    {
+        initialize(std::move(columnNames));
 
-            auto newChunks = std::make_shared<ChunkList>(NUM_PARALLEL_CHUNKS);
+        auto newChunks = std::make_shared<ChunkList>(NUM_PARALLEL_CHUNKS);
 
-            for (auto & c: *newChunks) {
-                auto newChunk = std::make_shared<MutableTabularDatasetChunk>
-                    (fixedColumns.size(), chunkSizeForNumColumns(fixedColumns.size()));
-                c.store(std::move(newChunk));
-            }
-            
-            auto old = mutableChunks.exchange(std::move(newChunks));
-            ExcAssert(!old);
+        for (auto & c: *newChunks) {
+            auto newChunk = newMutableChunk(fixedColumns.size());
+            c.store(std::move(newChunk));
         }
+
+        auto old = mutableChunks.exchange(std::move(newChunks));
+        ExcAssert(!old);
     }
 
     // Vals is std::vector<std::tuple<ColumnPath, CellValue, Date> >
@@ -2033,8 +3072,11 @@ struct TabularDataset::TabularDataStore
 
         for (unsigned i = 0;  i < vals.size();  ++i) {
             const ColumnPath & c = std::get<0>(vals[i]);
-            auto iter = fixedColumnIndex.find(c.oldHash());
-            if (iter == fixedColumnIndex.end()) {
+
+            // Rows usually have their columns in the same order as the
+            // first one, which is checked before hashing the name
+            int index = fixedColumnIndex.find(c, i);
+            if (index == -1) {
                 switch (config.unknownColumns) {
                 case UC_ERROR:
                     throw AnnotatedException
@@ -2052,7 +3094,7 @@ struct TabularDataset::TabularDataStore
                 }
             }
 
-            orderedVals[iter->second] = std::move(std::get<1>(vals[i]));
+            orderedVals[index] = std::move(std::get<1>(vals[i]));
 
             ts = std::max(ts, std::get<2>(vals[i]));
         }
@@ -2101,8 +3143,7 @@ struct TabularDataset::TabularDataStore
             else if (written
                      == MutableTabularDatasetChunk::ADD_PERFORM_ROTATION) {
                 // We need a rotation, and we've been selected to do it
-                auto newChunk = std::make_shared<MutableTabularDatasetChunk>
-                    (fixedColumns.size(), chunkSizeForNumColumns(fixedColumns.size()));
+                auto newChunk = newMutableChunk(fixedColumns.size());
                 if (mc->chunks[chunkNum]
                     .compare_exchange_strong(chunkPtr, newChunk)) {
                     // Successful rotation.  First we background freeze
@@ -2122,10 +3163,20 @@ TabularDataset(MldbEngine * owner,
                const ProgressFunc & onProgress)
     : Dataset(owner)
 {
+    auto params = config.params.convert<TabularDatasetConfig>();
+    if (params.chunkByteBudget == 0)
+        throw AnnotatedException(400, "Tabular dataset chunkByteBudget "
+                                  "must be greater than zero");
+    if (params.sparseRemainderFraction < 0.0
+        || params.sparseRemainderFraction > 1.0)
+        throw AnnotatedException(400, "Tabular dataset "
+                                  "sparseRemainderFraction must be between "
+                                  "0 and 1",
+                                  "sparseRemainderFraction",
+                                  params.sparseRemainderFraction);
+
     itl = make_shared<TabularDataStore>
-        (owner,
-         config.params.convert<TabularDatasetConfig>(),
-         MLDB::getMldbLog<TabularDataset>());
+        (owner, std::move(params), MLDB::getMldbLog<TabularDataset>());
 }
 
 TabularDataset::
@@ -2137,7 +3188,7 @@ Any
 TabularDataset::
 getStatus() const
 {
-    return itl->currentState.load()->getStatus();
+    return itl->getStatus();
 }
 
 std::pair<Date, Date>
@@ -2176,6 +3227,27 @@ getRowExpr(const RowPath & row) const
     return itl->getRowExpr(row);
 }
 
+std::function<ExpressionValue (const RowPath & row)>
+TabularDataset::
+getRowExprProjection(const UnboundEntities & unbound,
+                     const Utf8String & alias) const
+{
+    return itl->getRowExprProjection(unbound, alias);
+}
+
+GenerateRowsWhereFunction
+TabularDataset::
+generateColumnWhere(const SqlBindingScope & context,
+                    const Utf8String & alias,
+                    const SqlExpression & where,
+                    const ColumnPath & columnName) const
+{
+    // Reading a column means decoding it from every chunk, whereas a scan
+    // can skip the chunks that the zone maps rule out and only decode the
+    // rest of the column in the chunks it does look at
+    return GenerateRowsWhereFunction();
+}
+
 GenerateRowsWhereFunction
 TabularDataset::
 generateRowsWhere(const SqlBindingScope & context,
@@ -2188,6 +3260,15 @@ generateRowsWhere(const SqlBindingScope & context,
         = itl->generateRowsWhere(context, alias, where, offset, limit);
     if (!fn)
         fn = Dataset::generateRowsWhere(context, alias, where, offset, limit);
+
+    // If we ended up with a scan of the whole table, see if the zone maps
+    // allow us to skip some of the chunks, and only decode the columns
+    // that the where expression needs
+    if (fn.complexity == GenerateRowsWhereFunction::TABLESCAN) {
+        auto chunkScan = itl->generateChunkScan(*this, alias, where, fn);
+        if (chunkScan)
+            fn = std::move(chunkScan);
+    }
     return fn;
 }
 
@@ -2202,13 +3283,32 @@ void
 TabularDataset::
 commit()
 {
-    return itl->commit();
+    itl->commit();
+    dataChanged();
+}
+
+uint64_t
+TabularDataset::
+saveCheckpoint(const Url & dataFileUrl)
+{
+    uint64_t result = itl->saveCheckpoint(dataFileUrl);
+    dataChanged();
+    return result;
+}
+
+void
+TabularDataset::
+restoreCheckpoint(const std::vector<Url> & dataFileUrls)
+{
+    itl->restoreCheckpoint(dataFileUrls);
+    dataChanged();
 }
 
 Dataset::MultiChunkRecorder
 TabularDataset::
 getChunkRecorder()
 {
+    itl->checkWritable();
     MultiChunkRecorder result;
     result.newChunk = [=] (size_t)
         {
@@ -2225,6 +3325,7 @@ TabularDataset::
 recordRowItl(const RowPath & rowName,
              const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals)
 {
+    itl->checkWritable();
     validateNames(rowName, vals);
     itl->recordRow(rowName, vals);
 }
@@ -2233,6 +3334,7 @@ void
 TabularDataset::
 recordRows(const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > & rows)
 {
+    itl->checkWritable();
     for (auto & r: rows)
         itl->recordRow(r.first, r.second);
 }
@@ -2260,6 +3362,11 @@ TabularDatasetConfig::
 TabularDatasetConfig()
 {
     unknownColumns = UC_ERROR;
+    rowIndexBloomFilter = false;
+    rowIndexPerfectHash = false;
+    chunkByteBudget = 32 << 20;
+    sparseRemainderFraction = 0.001;
+    warmup = false;
 }
 
 DEFINE_ENUM_DESCRIPTION(UnknownColumnAction);
@@ -2284,6 +3391,48 @@ TabularDatasetConfigDescription()
              "'error' (default), or 'add' which will allow an unlimited "
              "number of sparse columns to be added.",
              UC_ERROR);
+    addField("dataFileUrl", &TabularDatasetConfig::dataFileUrl,
+             "URL of a file to persist the dataset to.  If the file "
+             "exists, the dataset is loaded from it without being "
+             "re-frozen and is read-only.  Otherwise the dataset is "
+             "written to it when it is committed.");
+    addField("rowIndexBloomFilter", &TabularDatasetConfig::rowIndexBloomFilter,
+             "Build a bloom filter in front of the row name index.  This "
+             "uses about 2 extra bytes per row, and makes looking up rows "
+             "that aren't in the dataset (for example in joins) much "
+             "cheaper.", false);
+    addField("rowIndexPerfectHash", &TabularDatasetConfig::rowIndexPerfectHash,
+             "Build the row name index as a minimal perfect hash when the "
+             "dataset is committed.  This makes commits slower, but the "
+             "index is smaller and each lookup looks at a single row.",
+             false);
+    addField("chunkByteBudget", &TabularDatasetConfig::chunkByteBudget,
+             "Approximate number of bytes of values to record in each chunk "
+             "before it is frozen.  The number of rows per chunk is "
+             "adapted to the width of the rows so that each chunk uses "
+             "about this much memory while it's being recorded.",
+             (uint64_t)(32 << 20));
+    addField("sparseRemainderFraction",
+             &TabularDatasetConfig::sparseRemainderFraction,
+             "Sparse columns that have a value in fewer than this fraction "
+             "of the rows of a chunk are stored together in a row-oriented "
+             "section of the chunk, rather than each in its own column.  "
+             "Zero stores every column in its own column.", 0.001);
+    addField("memoryPolicy", &TabularDatasetConfig::memoryPolicy,
+             "How the memory for the frozen columns is allocated: its "
+             "alignment, and whether large columns use huge pages and "
+             "a NUMA placement.  Huge pages reduce TLB misses when large "
+             "columns are accessed randomly.  Not used for datasets that "
+             "are loaded from `dataFileUrl`, which are memory mapped.");
+    addField("warmup", &TabularDatasetConfig::warmup,
+             "When the dataset is loaded from `dataFileUrl`, read its row "
+             "index and the row names, timestamps and zone maps of its "
+             "chunks into memory in the background, so that the first "
+             "queries don't wait for them to be paged in.  Progress is "
+             "shown in the `warmup` field of the status.  A warmup can "
+             "also be started with the `warmup` route.", false);
+    addField("warmupColumns", &TabularDatasetConfig::warmupColumns,
+             "Columns whose values are also read in by the warmup.");
 }
 
 namespace {
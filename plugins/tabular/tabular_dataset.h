@@ -13,6 +13,7 @@
 
 #include "mldb/core/dataset.h"
 #include "mldb/sql/sql_expression.h"
+#include "mldb/block/memory_region.h"
 
 
 namespace MLDB {
@@ -33,6 +34,36 @@ struct TabularDatasetConfig {
     TabularDatasetConfig();
 
     UnknownColumnAction unknownColumns;
+
+    /// If set, the dataset is loaded (memory mapped) from this file when
+    /// it exists, and saved to it on commit when it doesn't.
+    Url dataFileUrl;
+
+    /// If set, a bloom filter is built in front of the row name index so
+    /// that lookups of rows that aren't in the dataset are cheap.
+    bool rowIndexBloomFilter;
+
+    /// If set, the row name index is built as a minimal perfect hash on
+    /// commit, which is smaller and returns a single candidate per lookup.
+    bool rowIndexPerfectHash;
+
+    /// Approximate number of bytes to record in each chunk; the number
+    /// of rows per chunk is adapted to the size of the rows.
+    uint64_t chunkByteBudget;
+
+    /// Sparse columns with values in fewer than this fraction of the rows
+    /// of a chunk are stored in the chunk's row-oriented sparse remainder.
+    double sparseRemainderFraction;
+
+    /// How the memory for frozen chunks is allocated
+    MemoryAllocationPolicy memoryPolicy;
+
+    /// If set, the index structures of a dataset loaded from dataFileUrl
+    /// are read into memory in the background after it's loaded.
+    bool warmup;
+
+    /// Columns whose values are also read in by the warmup
+    std::vector<ColumnPath> warmupColumns;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(TabularDatasetConfig);
@@ -54,6 +85,10 @@ struct TabularDataset : public Dataset {
     virtual std::shared_ptr<RowStream> getRowStream() const;
 
     virtual ExpressionValue getRowExpr(const RowPath & row) const;
+
+    virtual std::function<ExpressionValue (const RowPath & row)>
+    getRowExprProjection(const UnboundEntities & unbound,
+                         const Utf8String & alias) const;
     
     virtual std::pair<Date, Date> getTimestampRange() const;
 
@@ -64,11 +99,21 @@ struct TabularDataset : public Dataset {
                       ssize_t offset,
                       ssize_t limit) const;
 
+    virtual GenerateRowsWhereFunction
+    generateColumnWhere(const SqlBindingScope & context,
+                        const Utf8String & alias,
+                        const SqlExpression & where,
+                        const ColumnPath & columnName) const;
+
     virtual KnownColumn getKnownColumnInfo(const ColumnPath & columnName) const;
 
     /** Commit changes to the database. */
     virtual void commit();
 
+    virtual uint64_t saveCheckpoint(const Url & dataFileUrl);
+
+    virtual void restoreCheckpoint(const std::vector<Url> & dataFileUrls);
+
     virtual MultiChunkRecorder getChunkRecorder();
 
     virtual void
@@ -7,9 +7,261 @@
 
 #include "tabular_dataset_chunk.h"
 #include "mldb/sql/expression_value.h"
+#include "mldb/types/value_description.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/arch/profile_scope.h"
+#include <algorithm>
+#include <set>
 
 namespace MLDB {
 
+/*****************************************************************************/
+/* SPARSE REMAINDER                                                          */
+/*****************************************************************************/
+
+namespace {
+
+/** Frozen column that presents one of the columns of a sparse remainder.
+    It keeps the entries of the remainder that belong to the column, and
+    the rows of those entries to search on; there are few of them, as
+    only rare columns are put in the remainder.
+*/
+struct SparseRemainderColumn: public FrozenColumn {
+
+    SparseRemainderColumn(std::shared_ptr<const SparseRemainder> remainder,
+                          std::vector<uint32_t> entries)
+        : remainder(std::move(remainder)), entries(std::move(entries))
+    {
+        ExcAssert(!this->entries.empty());
+        rows.reserve(this->entries.size());
+        for (auto & e: this->entries) {
+            rows.push_back(this->remainder->getRow(e));
+            columnTypes.update(this->remainder->getValue(e));
+        }
+    }
+
+    virtual std::string format() const
+    {
+        return "Rm";
+    }
+
+    /// Index in entries and rows of the given row, or -1 if not there
+    ssize_t find(uint32_t rowIndex) const
+    {
+        auto it = std::lower_bound(rows.begin(), rows.end(), rowIndex);
+        if (it == rows.end() || *it != rowIndex)
+            return -1;
+        return it - rows.begin();
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        ssize_t i = find(rowIndex);
+        if (i == -1)
+            return CellValue();
+        return remainder->getValue(entries[i]);
+    }
+
+    virtual size_t size() const
+    {
+        return rows.back() - rows.front() + 1;
+    }
+
+    virtual size_t memusage() const
+    {
+        return sizeof(*this) + entries.capacity() * sizeof(uint32_t)
+            + rows.capacity() * sizeof(uint32_t);
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        for (size_t i = 0;  i < entries.size();  ++i) {
+            if (!onRow(rows[i], remainder->getValue(entries[i])))
+                return false;
+        }
+        return true;
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        size_t i = 0;
+        for (uint32_t r = rows.front();  r <= rows.back();  ++r) {
+            if (rows[i] == r) {
+                if (!onRow(r, remainder->getValue(entries[i++])))
+                    return false;
+            }
+            else if (!onRow(r, CellValue()))
+                return false;
+        }
+        return true;
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        std::set<CellValue> distinct;
+        for (auto & e: entries)
+            distinct.insert(remainder->getValue(e));
+        // Rows between the first and the last one without a value are null
+        if (entries.size() < size())
+            distinct.insert(CellValue());
+        for (auto & v: distinct) {
+            if (!fn(v))
+                return false;
+        }
+        return true;
+    }
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    virtual size_t nonNullRowCount() const
+    {
+        return entries.size();
+    }
+
+    virtual void serialize(StructuredSerializer & serializer) const
+    {
+        throw AnnotatedException
+            (500, "Sparse remainder columns are serialized with their chunk");
+    }
+
+    std::shared_ptr<const SparseRemainder> remainder;
+    std::vector<uint32_t> entries;
+    std::vector<uint32_t> rows;
+    ColumnTypes columnTypes;
+};
+
+} // file scope
+
+SparseRemainder::
+SparseRemainder(const std::vector<std::pair<Path, TabularDatasetColumn *> > & columns,
+                MappedSerializer & serializer,
+                const ColumnFreezeParameters & params)
+{
+    // (row, column number, value index) for each value
+    std::vector<std::tuple<uint32_t, uint32_t, uint32_t> > allEntries;
+    for (size_t i = 0;  i < columns.size();  ++i) {
+        const TabularDatasetColumn & column = *columns[i].second;
+        for (auto & e: column.sparseIndexes) {
+            allEntries.emplace_back(column.minRowNumber + e.first, i,
+                                    e.second);
+        }
+    }
+    std::sort(allEntries.begin(), allEntries.end());
+
+    TabularDatasetColumn mutableRows, mutableNames, mutableValues;
+    mutableRows.reserve(allEntries.size());
+    mutableNames.reserve(allEntries.size());
+    mutableValues.reserve(allEntries.size());
+    for (size_t i = 0;  i < allEntries.size();  ++i) {
+        uint32_t row, col, val;
+        std::tie(row, col, val) = allEntries[i];
+        mutableRows.add(i, row);
+        mutableNames.add(i, CellValue(columns[col].first));
+        mutableValues.add(i, columns[col].second->indexedVals[val]);
+    }
+
+    rows = mutableRows.freeze(serializer, params);
+    names = mutableNames.freeze(serializer, params);
+    values = mutableValues.freeze(serializer, params);
+}
+
+SparseRemainder::
+SparseRemainder(StructuredReconstituter & reconstituter)
+{
+    rows = FrozenColumn::reconstitute(*reconstituter.getStructure("rows"));
+    names = FrozenColumn::reconstitute(*reconstituter.getStructure("names"));
+    values = FrozenColumn::reconstitute(*reconstituter.getStructure("values"));
+}
+
+std::pair<uint32_t, uint32_t>
+SparseRemainder::
+getRowEntries(uint32_t rowIndex) const
+{
+    // Binary search for the first entry of the row and the one after it
+    auto lowerBound = [&] (uint32_t row)
+        {
+            uint32_t first = 0, last = size();
+            while (first < last) {
+                uint32_t mid = first + (last - first) / 2;
+                if (getRow(mid) < row)
+                    first = mid + 1;
+                else last = mid;
+            }
+            return first;
+        };
+
+    uint32_t begin = lowerBound(rowIndex);
+    uint32_t end = begin;
+    while (end < size() && getRow(end) == rowIndex)
+        ++end;
+    return { begin, end };
+}
+
+uint32_t
+SparseRemainder::
+getRow(uint32_t entry) const
+{
+    return rows->get(entry).toInt();
+}
+
+Path
+SparseRemainder::
+getColumnName(uint32_t entry) const
+{
+    return names->get(entry).coerceToPath();
+}
+
+CellValue
+SparseRemainder::
+getValue(uint32_t entry) const
+{
+    return values->get(entry);
+}
+
+std::unordered_map<Path, std::shared_ptr<FrozenColumn>, PathNewHasher>
+SparseRemainder::
+getColumns(std::shared_ptr<const SparseRemainder> self) const
+{
+    ExcAssertEqual(self.get(), this);
+
+    std::unordered_map<Path, std::vector<uint32_t>, PathNewHasher> entries;
+    for (uint32_t i = 0;  i < size();  ++i) {
+        entries[getColumnName(i)].push_back(i);
+    }
+
+    std::unordered_map<Path, std::shared_ptr<FrozenColumn>, PathNewHasher> result;
+    for (auto & e: entries) {
+        result.emplace(e.first,
+                       std::make_shared<SparseRemainderColumn>
+                           (self, std::move(e.second)));
+    }
+    return result;
+}
+
+size_t
+SparseRemainder::
+memusage() const
+{
+    if (!rows)
+        return sizeof(*this);
+    return sizeof(*this) + rows->memusage() + names->memusage()
+        + values->memusage();
+}
+
+void
+SparseRemainder::
+serialize(StructuredSerializer & serializer) const
+{
+    rows->serialize(*serializer.newStructure("rows"));
+    names->serialize(*serializer.newStructure("names"));
+    values->serialize(*serializer.newStructure("values"));
+}
+
+
 /*****************************************************************************/
 /* TABULAR DATASET CHUNK                                                     */
 /*****************************************************************************/
@@ -30,6 +282,12 @@ memusage() const
     for (auto & c: sparseColumns)
         result += c.first.memusage() + c.second->memusage();
 
+    if (remainder) {
+        result += remainder->memusage();
+        for (auto & c: remainderColumns)
+            result += c.first.memusage() + c.second->memusage();
+    }
+
     //cerr << sparseColumns.size() << " sparse columns took "
     //     << result - before << endl;
     before = result;
@@ -57,9 +315,27 @@ maybeGetColumn(size_t columnIndex, const PathElement & columnName) const
     }
     else {
         auto it = sparseColumns.find(columnName);
-        if (it == sparseColumns.end())
+        if (it != sparseColumns.end())
+            return it->second.get();
+        auto it2 = remainderColumns.find(columnName);
+        if (it2 != remainderColumns.end())
+            return it2->second.get();
+        return nullptr;
+    }
+}
+
+const ColumnZoneMap *
+TabularDatasetChunk::
+maybeGetZoneMap(size_t columnIndex, const Path & columnName) const
+{
+    if (columnIndex < columns.size()) {
+        return &zoneMaps.at(columnIndex);
+    }
+    else {
+        auto it = sparseZoneMaps.find(columnName);
+        if (it == sparseZoneMaps.end())
             return nullptr;
-        return it->second.get();
+        return &it->second;
     }
 }
 
@@ -88,9 +364,27 @@ maybeGetColumn(size_t columnIndex, const Path & columnName) const
     }
     else {
         auto it = sparseColumns.find(columnName);
-        if (it == sparseColumns.end())
-            return nullptr;
-        return it->second.get();
+        if (it != sparseColumns.end())
+            return it->second.get();
+        auto it2 = remainderColumns.find(columnName);
+        if (it2 != remainderColumns.end())
+            return it2->second.get();
+        return nullptr;
+    }
+}
+
+void
+TabularDatasetChunk::
+addRemainderValues(size_t index, Date ts,
+                   std::vector<std::tuple<ColumnPath, CellValue, Date> > & result) const
+{
+    if (!remainder)
+        return;
+    uint32_t begin, end;
+    std::tie(begin, end) = remainder->getRowEntries(index);
+    for (uint32_t e = begin;  e < end;  ++e) {
+        result.emplace_back(remainder->getColumnName(e),
+                            remainder->getValue(e), ts);
     }
 }
 
@@ -99,6 +393,7 @@ std::vector<std::tuple<ColumnPath, CellValue, Date> >
 TabularDatasetChunk::
 getRow(size_t index, const std::vector<ColumnPath> & fixedColumnNames) const
 {
+    MLDB_PROFILE_SCOPE("tabular.frozenColumn");
     ExcAssertLess(index, rowCount());
     std::vector<std::tuple<ColumnPath, CellValue, Date> > result;
     result.reserve(columns.size());
@@ -117,6 +412,7 @@ getRow(size_t index, const std::vector<ColumnPath> & fixedColumnNames) const
         result.emplace_back(c.first, std::move(val), ts);
 
     }
+    addRemainderValues(index, ts, result);
     return result;
 }
 
@@ -125,6 +421,7 @@ ExpressionValue
 TabularDatasetChunk::
 getRowExpr(size_t index, const std::vector<ColumnPath> & fixedColumnNames) const
 {
+    MLDB_PROFILE_SCOPE("tabular.frozenColumn");
     ExcAssertLess(index, rowCount());
     std::vector<std::tuple<ColumnPath, CellValue, Date> > result;
     result.reserve(columns.size());
@@ -143,9 +440,32 @@ getRowExpr(size_t index, const std::vector<ColumnPath> & fixedColumnNames) const
         result.emplace_back(c.first, std::move(val), ts);
 
     }
+    addRemainderValues(index, ts, result);
     return std::move(result);
 }
 
+std::vector<std::tuple<ColumnPath, CellValue, Date> >
+TabularDatasetChunk::
+getRowColumns(size_t index,
+              const std::vector<std::pair<int, ColumnPath> > & columnsToGet) const
+{
+    MLDB_PROFILE_SCOPE("tabular.frozenColumn");
+    ExcAssertLess(index, rowCount());
+    std::vector<std::tuple<ColumnPath, CellValue, Date> > result;
+    result.reserve(columnsToGet.size());
+    Date ts = timestamps->get(index).mustCoerceToTimestamp();
+    for (auto & c: columnsToGet) {
+        const FrozenColumn * column = maybeGetColumn(c.first, c.second);
+        if (!column)
+            continue;
+        CellValue val = column->get(index);
+        if (val.empty())
+            continue;
+        result.emplace_back(c.second, std::move(val), ts);
+    }
+    return result;
+}
+
 void
 TabularDatasetChunk::
 addToColumn(int columnIndex,
@@ -153,12 +473,13 @@ addToColumn(int columnIndex,
             std::vector<std::tuple<RowPath, CellValue, Date> > & rows,
             bool dense) const
 {
+    MLDB_PROFILE_SCOPE("tabular.frozenColumn");
     const FrozenColumn * col = nullptr;
     if (columnIndex < columns.size())
         col = columns[columnIndex].get();
     else {
-        auto it = sparseColumns.find(colName);
-        if (it == sparseColumns.end()) {
+        col = maybeGetColumn(columnIndex, colName);
+        if (!col) {
             if (dense) {
                 for (unsigned i = 0;  i < rowCount();  ++i) {
                     rows.emplace_back(getRowPath(i),
@@ -168,7 +489,6 @@ addToColumn(int columnIndex,
             }
             return;
         }
-        col = it->second.get();
     }
 
     for (unsigned i = 0;  i < rowCount();  ++i) {
@@ -201,8 +521,70 @@ serialize(StructuredSerializer & serializer) const
             c.second->serialize(*sparseSerializer->newStructure(c.first.toUtf8String()));
         }
     }
+    if (remainder)
+        remainder->serialize(*serializer.newStructure("rm"));
     serializeAs("rn", *rowNames);
     serializeAs("ts", *timestamps);
+
+    auto zoneMapSerializer = serializer.newStructure("zm");
+    for (size_t i = 0;  i < zoneMaps.size();  ++i) {
+        zoneMapSerializer->newObject(to_string(i), zoneMaps[i]);
+    }
+    if (!sparseZoneMaps.empty()) {
+        auto sparseSerializer = zoneMapSerializer->newStructure("sp");
+        for (auto & z: sparseZoneMaps) {
+            sparseSerializer->newObject(z.first.toUtf8String(), z.second);
+        }
+    }
+}
+
+
+TabularDatasetChunk::
+TabularDatasetChunk(StructuredReconstituter & reconstituter)
+{
+    std::set<PathElement> entries;
+    for (auto & e: reconstituter.getDirectory())
+        entries.insert(e.name);
+
+    while (entries.count(PathElement(columns.size()))) {
+        columns.emplace_back(FrozenColumn::reconstitute
+                             (*reconstituter.getStructure(columns.size())));
+    }
+
+    if (entries.count("sp")) {
+        auto sparseReconstituter = reconstituter.getStructure("sp");
+        for (auto & e: sparseReconstituter->getDirectory()) {
+            sparseColumns.emplace(Path::parse(e.name.toUtf8String()),
+                                  FrozenColumn::reconstitute(*e.getStructure()));
+        }
+    }
+
+    if (entries.count("rm")) {
+        auto newRemainder = std::make_shared<SparseRemainder>
+            (*reconstituter.getStructure("rm"));
+        remainderColumns = newRemainder->getColumns(newRemainder);
+        remainder = std::move(newRemainder);
+    }
+
+    rowNames = FrozenColumn::reconstitute(*reconstituter.getStructure("rn"));
+    timestamps = FrozenColumn::reconstitute(*reconstituter.getStructure("ts"));
+
+    // There are no zone map entries at all when the chunk has no columns
+    if (columns.empty() && sparseColumns.empty() && remainderColumns.empty())
+        return;
+
+    auto zoneMapReconstituter = reconstituter.getStructure("zm");
+    zoneMaps.resize(columns.size());
+    for (size_t i = 0;  i < columns.size();  ++i) {
+        zoneMapReconstituter->getObject(i, zoneMaps[i]);
+    }
+    if (!sparseColumns.empty() || !remainderColumns.empty()) {
+        auto sparseReconstituter = zoneMapReconstituter->getStructure("sp");
+        for (auto & e: sparseReconstituter->getDirectory()) {
+            sparseReconstituter->getObject
+                (e.name, sparseZoneMaps[Path::parse(e.name.toUtf8String())]);
+        }
+    }
 }
 
 
@@ -211,8 +593,8 @@ serialize(StructuredSerializer & serializer) const
 /*****************************************************************************/
 
 MutableTabularDatasetChunk::
-MutableTabularDatasetChunk(size_t numColumns, size_t maxSize)
-    : maxSize(maxSize), rowCount_(0),
+MutableTabularDatasetChunk(size_t numColumns, size_t maxSize, size_t maxBytes)
+    : maxSize(maxSize), maxBytes(maxBytes), rowCount_(0), bytesRecorded_(0),
       columns(numColumns), isFrozen(false),
       addFailureNotified(false)
 {
@@ -225,7 +607,8 @@ MutableTabularDatasetChunk(size_t numColumns, size_t maxSize)
 TabularDatasetChunk
 MutableTabularDatasetChunk::
 freeze(MappedSerializer & serializer,
-       const ColumnFreezeParameters & params)
+       const ColumnFreezeParameters & params,
+       double remainderFraction)
 {
     std::unique_lock<std::mutex> guard(mutex);
 
@@ -234,11 +617,33 @@ freeze(MappedSerializer & serializer,
     TabularDatasetChunk result;
     result.columns.resize(columns.size());
     result.sparseColumns.reserve(sparseColumns.size());
+    result.zoneMaps.reserve(columns.size());
+    result.sparseZoneMaps.reserve(sparseColumns.size());
 
-    for (unsigned i = 0;  i < columns.size();  ++i)
+    // Zone maps need to be taken before freezing, which consumes the
+    // values of the column
+    for (unsigned i = 0;  i < columns.size();  ++i) {
+        result.zoneMaps.emplace_back
+            (ColumnZoneMap::fromColumn(columns[i], rowCount_));
         result.columns[i] = columns[i].freeze(serializer, params);
-    for (auto & c: sparseColumns)
+    }
+    std::vector<std::pair<Path, TabularDatasetColumn *> > remainderColumns;
+    for (auto & c: sparseColumns) {
+        result.sparseZoneMaps.emplace
+            (c.first, ColumnZoneMap::fromColumn(c.second, rowCount_));
+        if (c.second.sparseIndexes.size() < remainderFraction * rowCount_) {
+            remainderColumns.emplace_back(c.first, &c.second);
+            continue;
+        }
         result.sparseColumns.emplace(c.first, c.second.freeze(serializer, params));
+    }
+
+    if (!remainderColumns.empty()) {
+        auto remainder = std::make_shared<SparseRemainder>
+            (remainderColumns, serializer, params);
+        result.remainderColumns = remainder->getColumns(remainder);
+        result.remainder = std::move(remainder);
+    }
 
     result.timestamps = timestamps.freeze(serializer, params);
     result.rowNames = rowNames.freeze(serializer, params);
@@ -261,7 +666,7 @@ add(RowPath & rowName,
         return ADD_AWAIT_ROTATION;
     size_t numRows = rowCount_;
 
-    if (numRows == maxSize) {
+    if (numRows == maxSize || (maxBytes && bytesRecorded_ >= maxBytes)) {
         if (addFailureNotified)
             return ADD_AWAIT_ROTATION;
         else {
@@ -279,18 +684,35 @@ add(RowPath & rowName,
 
     timestamps.add(numRows, ts.secondsSinceEpoch());
 
+    size_t rowBytes = ROW_OVERHEAD_BYTES;
     for (unsigned i = 0;  i < columns.size();  ++i) {
+        rowBytes += valueBytes(vals[i]);
         columns[i].add(numRows, std::move(vals[i]));
     }
 
     for (auto & e: extra) {
-        auto it = sparseColumns.emplace(std::move(e.first), TabularDatasetColumn()).first;
-        it->second.add(numRows, std::move(e.second));
+        rowBytes += valueBytes(e.second);
+        auto inserted = sparseColumns.emplace(std::move(e.first), TabularDatasetColumn());
+        if (inserted.second)
+            rowBytes += sizeof(*inserted.first) + inserted.first->first.memusage();
+        inserted.first->second.add(numRows, std::move(e.second));
     }
 
     ++rowCount_;
+    bytesRecorded_ += rowBytes;
 
     return ADD_SUCCEEDED;
 }
 
+size_t
+MutableTabularDatasetChunk::
+valueBytes(const CellValue & val)
+{
+    if (val.empty())
+        return 0;
+    // The index entry, and the value itself.  Repeated values are only
+    // stored once, so this is an upper bound.
+    return sizeof(std::pair<uint32_t, uint32_t>) + val.memusage();
+}
+
 } // namespace MLDB
@@ -13,6 +13,7 @@
 #include "mldb/types/date.h"
 #include "tabular_dataset_column.h"
 #include "tabular_dataset.h"
+#include "zone_map.h"
 #include <mutex>
 
 
@@ -23,6 +24,65 @@ struct Path;
 struct ExpressionValue;
 
 
+/*****************************************************************************/
+/* SPARSE REMAINDER                                                          */
+/*****************************************************************************/
+
+/** Row store for the values of the rare sparse columns of a chunk, which
+    would otherwise each need a frozen column of their own.  The values
+    are stored as (row, column, value) entries sorted by row, in three
+    frozen columns, so that all of the values of a row are together.
+
+    Each column stored here is also presented as a FrozenColumn (see
+    getColumns()), so that the rest of the dataset doesn't need to know
+    where its values are stored.
+*/
+
+struct SparseRemainder {
+
+    SparseRemainder() = default;
+
+    /** Create from the given sparse columns of a mutable chunk.  Their
+        values are copied; the columns are left as they were.
+    */
+    SparseRemainder(const std::vector<std::pair<Path, TabularDatasetColumn *> > & columns,
+                    MappedSerializer & serializer,
+                    const ColumnFreezeParameters & params);
+
+    /** Reconstitute a remainder that was written with serialize(). */
+    SparseRemainder(StructuredReconstituter & reconstituter);
+
+    /// Number of (row, column, value) entries
+    size_t size() const
+    {
+        return rows ? rows->size() : 0;
+    }
+
+    /// Range of entries that belong to the given row
+    std::pair<uint32_t, uint32_t> getRowEntries(uint32_t rowIndex) const;
+
+    uint32_t getRow(uint32_t entry) const;
+
+    Path getColumnName(uint32_t entry) const;
+
+    CellValue getValue(uint32_t entry) const;
+
+    /** Return a frozen column for each of the columns stored here.  They
+        hold a reference to this object.
+    */
+    std::unordered_map<Path, std::shared_ptr<FrozenColumn>, PathNewHasher>
+    getColumns(std::shared_ptr<const SparseRemainder> self) const;
+
+    size_t memusage() const;
+
+    void serialize(StructuredSerializer & serializer) const;
+
+    std::shared_ptr<FrozenColumn> rows;     ///< Row number of each entry
+    std::shared_ptr<FrozenColumn> names;    ///< Column name of each entry
+    std::shared_ptr<FrozenColumn> values;   ///< Value of each entry
+};
+
+
 /*****************************************************************************/
 /* TABULAR DATASET CHUNK                                                     */
 /*****************************************************************************/
@@ -38,6 +98,11 @@ struct TabularDatasetChunk {
     {
     }
 
+    /** Reconstitute a chunk that was written with serialize().  The
+        columns are mapped from the reconstituter, not copied.
+    */
+    TabularDatasetChunk(StructuredReconstituter & reconstituter);
+
     TabularDatasetChunk(TabularDatasetChunk && other) noexcept
     {
         swap(other);
@@ -53,6 +118,10 @@ struct TabularDatasetChunk {
     {
         columns.swap(other.columns);
         sparseColumns.swap(other.sparseColumns);
+        zoneMaps.swap(other.zoneMaps);
+        sparseZoneMaps.swap(other.sparseZoneMaps);
+        remainder.swap(other.remainder);
+        remainderColumns.swap(other.remainderColumns);
         rowNames.swap(other.rowNames);
         std::swap(timestamps, other.timestamps);
     }
@@ -81,6 +150,13 @@ struct TabularDatasetChunk {
         return *columns.at(columnIndex);
     }
 
+    /** Return the zone map for the given column, or nullptr if the column
+        has no values in this chunk (which is the case for a sparse column
+        that wasn't recorded).
+    */
+    const ColumnZoneMap *
+    maybeGetZoneMap(size_t columnIndex, const Path & columnName) const;
+
     /// Get the row with the given index
     std::vector<std::tuple<ColumnPath, CellValue, Date> >
     getRow(size_t index, const std::vector<Path> & fixedColumnNames) const;
@@ -89,6 +165,14 @@ struct TabularDatasetChunk {
     ExpressionValue
     getRowExpr(size_t index, const std::vector<Path> & fixedColumnNames) const;
 
+    /** Get only the given columns of the row with the given index.  Each
+        column is given by its index and name, as for maybeGetColumn(), so
+        that the other columns don't need to be decoded.
+    */
+    std::vector<std::tuple<ColumnPath, CellValue, Date> >
+    getRowColumns(size_t index,
+                  const std::vector<std::pair<int, ColumnPath> > & columnsToGet) const;
+
     /// Add the given column to the column with the given index
     void addToColumn(int columnIndex,
                      const Path & colName,
@@ -102,20 +186,32 @@ struct TabularDatasetChunk {
 
     size_t sparseColumnCount() const
     {
-        return sparseColumns.size();
+        return sparseColumns.size() + remainderColumns.size();
     }
 
     size_t columnCount() const
     {
-        return columns.size() + sparseColumns.size();
+        return columns.size() + sparseColumnCount();
     }
 
     /** Serialize to the given serializer. */
     void serialize(StructuredSerializer & serializer) const;
 
 private:
+    /// Add the values of the given row that are in the remainder
+    void addRemainderValues(size_t index, Date ts,
+                            std::vector<std::tuple<ColumnPath, CellValue, Date> > & result) const;
+
     std::vector<std::shared_ptr<FrozenColumn> > columns;
     std::unordered_map<Path, std::shared_ptr<FrozenColumn>, PathNewHasher> sparseColumns;
+    /// Zone maps for the dense columns, in the same order as columns
+    std::vector<ColumnZoneMap> zoneMaps;
+    /// Zone maps for the sparse columns, including those in the remainder
+    std::unordered_map<Path, ColumnZoneMap, PathNewHasher> sparseZoneMaps;
+    /// Values of the rare sparse columns; null if there are none
+    std::shared_ptr<const SparseRemainder> remainder;
+    /// Columns that are stored in the remainder
+    std::unordered_map<Path, std::shared_ptr<FrozenColumn>, PathNewHasher> remainderColumns;
     std::shared_ptr<FrozenColumn> rowNames;
     std::shared_ptr<FrozenColumn> timestamps;
 
@@ -134,13 +230,23 @@ private:
 
 struct MutableTabularDatasetChunk {
 
-    MutableTabularDatasetChunk(size_t numColumns, size_t maxSize);
+    /** Create a chunk with the given number of dense columns, that holds
+        up to maxSize rows and, if maxBytes isn't zero, about maxBytes of
+        recorded values.
+    */
+    MutableTabularDatasetChunk(size_t numColumns, size_t maxSize,
+                               size_t maxBytes = 0);
 
     MutableTabularDatasetChunk(MutableTabularDatasetChunk && other) noexcept = delete;
     MutableTabularDatasetChunk & operator = (MutableTabularDatasetChunk && other) noexcept = delete;
 
+    /** Freeze the chunk.  Sparse columns with values in fewer than
+        remainderFraction of the rows are stored together in the chunk's
+        sparse remainder rather than in a frozen column each.
+    */
     TabularDatasetChunk freeze(MappedSerializer & serializer,
-                               const ColumnFreezeParameters & params);
+                               const ColumnFreezeParameters & params,
+                               double remainderFraction = 0.0);
 
     /// Protect access in a multithreaded context
     mutable std::mutex mutex;
@@ -148,14 +254,31 @@ struct MutableTabularDatasetChunk {
     /// Maximum size, in rows
     size_t maxSize;
 
+    /// Maximum size, in (estimated) bytes recorded; zero means no limit
+    size_t maxBytes;
+
     /// Number of rows added so far
     size_t rowCount_;
 
+    /// Estimated number of bytes recorded so far
+    size_t bytesRecorded_;
+
     size_t rowCount() const
     {
         return rowCount_;
     }
 
+    size_t bytesRecorded() const
+    {
+        return bytesRecorded_;
+    }
+
+    /// Estimated bytes required to record a row, besides its values
+    static constexpr size_t ROW_OVERHEAD_BYTES = 32;
+
+    /// Estimated bytes required to record the given value
+    static size_t valueBytes(const CellValue & val);
+
     /// Set of known, dense valued columns
     std::vector<TabularDatasetColumn> columns;
 
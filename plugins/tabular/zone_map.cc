@@ -0,0 +1,177 @@
+/** zone_map.cc                                                    -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Implementation of per-chunk column zone maps.
+*/
+
+#include "zone_map.h"
+#include "tabular_dataset_column.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/basic_value_descriptions.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* COLUMN ZONE MAP                                                           */
+/*****************************************************************************/
+
+IMPLEMENT_STRUCTURE_DESCRIPTION(ColumnZoneMap)
+{
+    setVersion(1);
+    addField("numNulls", &ColumnZoneMap::numNulls,
+             "Number of rows in the chunk with no value");
+    addField("numNonNull", &ColumnZoneMap::numNonNull,
+             "Number of rows in the chunk with a value");
+    addField("hasRange", &ColumnZoneMap::hasRange,
+             "Are minValue and maxValue set?");
+    addField("minValue", &ColumnZoneMap::minValue,
+             "Minimum value in the chunk");
+    addField("maxValue", &ColumnZoneMap::maxValue,
+             "Maximum value in the chunk");
+    addField("stringBloom", &ColumnZoneMap::stringBloom,
+             "Bloom filter over the string values in the chunk");
+}
+
+namespace {
+
+// Number of probes per value.  With 10 bits per value this gives a
+// false positive rate of under 2%.
+static constexpr int BLOOM_NUM_PROBES = 3;
+static constexpr int BLOOM_BITS_PER_VALUE = 10;
+
+bool isStringLike(const CellValue & val)
+{
+    return val.isString() || val.isBlob();
+}
+
+// Call onBit for each of the bits of the bloom filter for the value.
+// We use double hashing of the two halves of the value's hash.
+template<typename Fn>
+bool forEachBloomBit(const CellValue & val, size_t numBits, Fn && onBit)
+{
+    uint64_t h = val.hash().hash();
+    uint32_t h1 = h;
+    uint32_t h2 = (h >> 32) | 1;
+    for (int i = 0;  i < BLOOM_NUM_PROBES;  ++i) {
+        if (!onBit((h1 + (uint64_t)i * h2) % numBits))
+            return false;
+    }
+    return true;
+}
+
+} // file scope
+
+ColumnZoneMap
+ColumnZoneMap::
+fromColumn(const TabularDatasetColumn & column, size_t numRows)
+{
+    ColumnZoneMap result;
+    result.numNonNull = column.sparseIndexes.size();
+    ExcAssertGreaterEqual(numRows, result.numNonNull);
+    result.numNulls = numRows - result.numNonNull;
+
+    if (column.indexedVals.empty())
+        return result;
+
+    const CellValue * minVal = &column.indexedVals[0];
+    const CellValue * maxVal = &column.indexedVals[0];
+    size_t numStrings = 0;
+    for (auto & v: column.indexedVals) {
+        if (v < *minVal)
+            minVal = &v;
+        if (*maxVal < v)
+            maxVal = &v;
+        numStrings += isStringLike(v);
+    }
+
+    auto isShort = [] (const CellValue & v)
+        {
+            if (v.isBlob())
+                return v.blobLength() <= MAX_RANGE_VALUE_LENGTH;
+            return !v.isString()
+                || v.toStringLength() <= MAX_RANGE_VALUE_LENGTH;
+        };
+
+    if (isShort(*minVal) && isShort(*maxVal)) {
+        result.hasRange = true;
+        result.minValue = *minVal;
+        result.maxValue = *maxVal;
+    }
+
+    if (numStrings > 0 && numStrings <= MAX_BLOOM_VALUES) {
+        size_t numWords = (numStrings * BLOOM_BITS_PER_VALUE + 63) / 64;
+        size_t numBits = numWords * 64;
+        result.stringBloom.resize(numWords, 0);
+        for (auto & v: column.indexedVals) {
+            if (!isStringLike(v))
+                continue;
+            forEachBloomBit(v, numBits, [&] (size_t bit)
+                            {
+                                result.stringBloom[bit / 64]
+                                    |= uint64_t(1) << (bit % 64);
+                                return true;
+                            });
+        }
+    }
+
+    return result;
+}
+
+bool
+ColumnZoneMap::
+mayContain(const CellValue & constant) const
+{
+    if (numNonNull == 0 || constant.empty())
+        return false;
+
+    if (hasRange && (constant < minValue || maxValue < constant))
+        return false;
+
+    if (!stringBloom.empty() && isStringLike(constant)) {
+        size_t numBits = stringBloom.size() * 64;
+        return forEachBloomBit(constant, numBits, [&] (size_t bit)
+                               {
+                                   return (stringBloom[bit / 64]
+                                           >> (bit % 64)) & 1;
+                               });
+    }
+
+    return true;
+}
+
+bool
+ColumnZoneMap::
+mayMatch(const std::string & op, const CellValue & constant) const
+{
+    if (op == "IS NULL")
+        return numNulls > 0;
+    if (op == "IS NOT NULL")
+        return numNonNull > 0;
+
+    if (numNonNull == 0 || constant.empty())
+        return false;
+
+    if (op == "=" || op == "==")
+        return mayContain(constant);
+
+    if (!hasRange)
+        return true;
+
+    // These mirror the ExpressionValue comparison operators, which are
+    // all expressed in terms of operator <.
+    if (op == "<")
+        return minValue < constant;
+    if (op == "<=")
+        return !(constant < minValue);
+    if (op == ">")
+        return constant < maxValue;
+    if (op == ">=")
+        return !(maxValue < constant);
+
+    return true;
+}
+
+} // namespace MLDB
@@ -0,0 +1,79 @@
+/** zone_map.h                                                     -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Per-chunk summary of the values in a column, used to skip chunks that
+    can't possibly match a WHERE clause without looking at their rows.
+*/
+
+#pragma once
+
+#include "mldb/sql/cell_value.h"
+#include "mldb/types/value_description_fwd.h"
+#include <vector>
+
+
+namespace MLDB {
+
+struct TabularDatasetColumn;
+
+
+/*****************************************************************************/
+/* COLUMN ZONE MAP                                                           */
+/*****************************************************************************/
+
+/** Records the range of values of a column within a single chunk, the
+    number of null and non-null rows, and for columns with a small number
+    of distinct strings a bloom filter over them.
+
+    The range uses the CellValue total order, which is the order that SQL
+    comparisons between atoms use, and so a comparison against a constant
+    outside of [minValue, maxValue] can't be true for any row.
+*/
+
+struct ColumnZoneMap {
+
+    /** Build the zone map for the given column of a chunk with numRows
+        rows.  This must be called before the column is frozen, as freezing
+        it moves its values away.
+    */
+    static ColumnZoneMap fromColumn(const TabularDatasetColumn & column,
+                                    size_t numRows);
+
+    /// Number of rows in the chunk with no value for this column
+    uint64_t numNulls = 0;
+
+    /// Number of rows in the chunk with a value for this column
+    uint64_t numNonNull = 0;
+
+    /// Is the range known?  It isn't recorded for very long values.
+    bool hasRange = false;
+
+    /// Minimum and maximum non-null value (when hasRange is set)
+    CellValue minValue;
+    CellValue maxValue;
+
+    /// Bloom filter over the string values of the column.  Empty means
+    /// that there is none and any string could be there.
+    std::vector<uint64_t> stringBloom;
+
+    /** Could a comparison "value op constant" be true for any row of
+        the chunk?  The op is one of the SQL comparison operators; SQL
+        comparisons with null are never true, so an all-null chunk never
+        matches.  The op can also be "IS NULL" or "IS NOT NULL", in which
+        case the constant is ignored.  Returns true if it's not known.
+    */
+    bool mayMatch(const std::string & op, const CellValue & constant) const;
+
+    /** Could any row of the chunk have a value equal to the constant? */
+    bool mayContain(const CellValue & constant) const;
+
+    /// Longest string or blob value for which we keep the range
+    static constexpr size_t MAX_RANGE_VALUE_LENGTH = 256;
+
+    /// Most distinct strings we'll put into a bloom filter
+    static constexpr size_t MAX_BLOOM_VALUES = 256;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(ColumnZoneMap);
+
+} // namespace MLDB
@@ -42,6 +42,7 @@
 #include "tensorflow/cc/ops/image_ops.h"
 #include "tensorflow/cc/ops/standard_ops.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_util.h"
 #include "tensorflow/core/graph/default_device.h"
 #include "tensorflow/core/graph/graph_def_builder.h"
 #include "tensorflow/core/lib/core/errors.h"
@@ -537,6 +538,34 @@ struct TensorflowGraphBase: public Function {
 
     mutable std::mutex queueLock;
     mutable std::condition_variable queueCond;
+
+    /// Largest number of rows (the first dimension of the inputs) that
+    /// concurrent calls are coalesced into for a single run of the graph.
+    /// One means that each call runs on its own.
+    int maxBatchSize = 1;
+
+    /// Longest time that the first call of a batch waits for others to
+    /// join it before the batch is run.
+    double maxBatchLatencyMs = 0;
+
+    /// Concurrent calls with the same input signature that are run
+    /// together.  Protected by batchLock; once a batch is no longer in
+    /// openBatches, only the call that leads it touches it until done
+    /// is set.
+    struct Batch {
+        int64_t numRows = 0;
+        bool full = false;
+        bool done = false;
+        std::vector<const std::vector<tensorflow::Tensor> *> inputs;
+        std::vector<tensorflow::int64> rows;
+        std::vector<std::vector<tensorflow::Tensor> > outputs;
+        std::exception_ptr exc;
+        std::condition_variable cond;
+    };
+
+    /// Batch that is currently accepting calls, per input signature
+    mutable std::map<std::string, std::shared_ptr<Batch> > openBatches;
+    mutable std::mutex batchLock;
     
 
     Any getStatus() const
@@ -772,8 +801,8 @@ struct TensorflowGraphBase: public Function {
 
             auto doRun = [&] (int i)
                 {
-                    auto output = owner->call(inputTensors, inputLayers,
-                                              outputLayers, i);
+                    auto output = owner->callBatched(inputTensors, inputLayers,
+                                                     outputLayers);
 
                     if (i == 0)
                         outputs = std::move(output);
@@ -1131,17 +1160,20 @@ struct TensorflowGraphBase: public Function {
             return ExpressionValue(std::move(cell), ts);
         }
         
-        auto flattened = tensor.flat<T>();
-        size_t n = flattened.size();
         DimsVector shape;
         for (unsigned i = 0;  i < tensor.dims();  ++i) {
             shape.emplace_back(tensor.dim_size(i));
         }
-        vector<CellValue> cells(n);
-        for (size_t i = 0;  i < n;  ++i) {
-            cells[i] = flattened(i);
-        }
-        return ExpressionValue(std::move(cells), ts, shape);
+
+        // The embedding shares the (aligned) buffer of the tensor rather
+        // than copying it out.  Tensors are reference counted handles to
+        // their buffer, so holding a copy keeps the buffer alive.
+        auto holder = std::make_shared<tensorflow::Tensor>(tensor);
+        std::shared_ptr<const void> data(holder, holder->flat<T>().data());
+
+        return ExpressionValue::embedding(ts, std::move(data),
+                                          GetStorageType<T>::val,
+                                          std::move(shape));
     }
 
     static ExpressionValue tensorToValueT(const tensorflow::Tensor & tensor,
@@ -1461,6 +1493,175 @@ struct TensorflowGraphBase: public Function {
         return outputs;
     }
 
+    /** Run the graph on the inputs, coalescing the call with any
+        concurrent calls that have the same signature into a single run
+        of the graph over the concatenation of their inputs.  The inputs
+        are concatenated along their first dimension and the outputs
+        split along theirs, so the graph must treat the first dimension
+        of all of its inputs and outputs as the batch.
+
+        The first call of a batch waits up to maxBatchLatencyMs for
+        others to join, or until maxBatchSize rows have been collected,
+        then runs the batch and hands each of the others its slice of
+        the outputs.
+    */
+    std::vector<tensorflow::Tensor>
+    callBatched(const std::vector<tensorflow::Tensor> & inputs,
+                const std::vector<string> & inputLayers,
+                const std::vector<string> & outputLayers) const
+    {
+        if (maxBatchSize <= 1 || inputs.empty())
+            return call(inputs, inputLayers, outputLayers, 0);
+
+        // Calls can only be concatenated if their inputs agree on
+        // everything but the size of the first dimension.  Those that
+        // can't be are run on their own.
+        std::string signature;
+        int64_t numRows = -1;
+        for (unsigned i = 0;  i < inputs.size();  ++i) {
+            const tensorflow::Tensor & tensor = inputs[i];
+            if (tensor.dims() == 0
+                || (numRows != -1 && tensor.dim_size(0) != numRows))
+                return call(inputs, inputLayers, outputLayers, 0);
+            numRows = tensor.dim_size(0);
+
+            signature += inputLayers[i] + ':'
+                + std::to_string(tensor.dtype());
+            for (int d = 1;  d < tensor.dims();  ++d)
+                signature += ',' + std::to_string(tensor.dim_size(d));
+            signature += ';';
+        }
+        for (const auto & l: outputLayers)
+            signature += l + ';';
+
+        if (numRows <= 0 || numRows > maxBatchSize)
+            return call(inputs, inputLayers, outputLayers, 0);
+
+        std::unique_lock<std::mutex> guard(batchLock);
+
+        // Closes the batch to new calls and wakes up its leader
+        auto closeBatch = [&] (const std::shared_ptr<Batch> & batch)
+            {
+                auto it = openBatches.find(signature);
+                if (it != openBatches.end() && it->second == batch)
+                    openBatches.erase(it);
+                batch->full = true;
+                batch->cond.notify_all();
+            };
+
+        std::shared_ptr<Batch> batch;
+        auto it = openBatches.find(signature);
+        if (it != openBatches.end()
+            && it->second->numRows + numRows <= maxBatchSize) {
+            batch = it->second;
+        }
+        else {
+            // Doesn't fit in the open batch, so send that one on its
+            // way and start a new one
+            if (it != openBatches.end())
+                closeBatch(it->second);
+            batch = std::make_shared<Batch>();
+            openBatches[signature] = batch;
+        }
+
+        size_t index = batch->inputs.size();
+        batch->inputs.push_back(&inputs);
+        batch->rows.push_back(numRows);
+        batch->numRows += numRows;
+
+        if (index == 0) {
+            // We lead the batch: wait for others to join, then run it
+            auto deadline = std::chrono::steady_clock::now()
+                + std::chrono::microseconds
+                    ((int64_t)(maxBatchLatencyMs * 1000));
+            batch->cond.wait_until(guard, deadline,
+                                   [&] ()
+                                   {
+                                       return batch->full
+                                           || batch->numRows >= maxBatchSize;
+                                   });
+            closeBatch(batch);
+
+            guard.unlock();
+            runBatch(*batch, inputLayers, outputLayers);
+            guard.lock();
+
+            batch->done = true;
+            batch->cond.notify_all();
+        }
+        else {
+            if (batch->numRows >= maxBatchSize)
+                closeBatch(batch);
+            batch->cond.wait(guard, [&] () { return batch->done; });
+        }
+
+        if (batch->exc)
+            std::rethrow_exception(batch->exc);
+
+        return std::move(batch->outputs[index]);
+    }
+
+    /// Run a closed batch, recording its outputs or exception
+    void runBatch(Batch & batch,
+                  const std::vector<string> & inputLayers,
+                  const std::vector<string> & outputLayers) const
+    {
+        using namespace tensorflow;
+
+        size_t numCalls = batch.inputs.size();
+
+        try {
+            if (numCalls == 1) {
+                batch.outputs.emplace_back
+                    (call(*batch.inputs[0], inputLayers, outputLayers, 0));
+                return;
+            }
+
+            vector<Tensor> batchInputs;
+            for (unsigned i = 0;  i < inputLayers.size();  ++i) {
+                vector<Tensor> parts;
+                for (auto * callInputs: batch.inputs)
+                    parts.push_back((*callInputs)[i]);
+                Tensor joined;
+                Status status = tensor::Concat(parts, &joined);
+                if (!status.ok())
+                    throw AnnotatedException
+                        (500, "Unable to concatenate batch for input '"
+                         + inputLayers[i] + "': " + status.error_message());
+                batchInputs.emplace_back(std::move(joined));
+            }
+
+            DEBUG_MSG(logger) << "running batch of " << numCalls
+                              << " calls with " << batch.numRows << " rows";
+
+            vector<Tensor> outputs
+                = call(batchInputs, inputLayers, outputLayers, 0);
+
+            batch.outputs.resize(numCalls);
+            for (unsigned i = 0;  i < outputs.size();  ++i) {
+                if (outputs[i].dims() == 0
+                    || outputs[i].dim_size(0) != batch.numRows) {
+                    throw AnnotatedException
+                        (400, "Output '" + outputLayers[i] + "' of a "
+                         "batched call doesn't have the batch as its first "
+                         "dimension; set maxBatchSize to 1 for this graph",
+                         "batchRows", batch.numRows,
+                         "outputShape", outputs[i].shape().DebugString());
+                }
+                vector<Tensor> pieces;
+                Status status = tensor::Split(outputs[i], batch.rows, &pieces);
+                if (!status.ok())
+                    throw AnnotatedException
+                        (500, "Unable to split batch for output '"
+                         + outputLayers[i] + "': " + status.error_message());
+                for (size_t j = 0;  j < numCalls;  ++j)
+                    batch.outputs[j].emplace_back(std::move(pieces[j]));
+            }
+        } MLDB_CATCH_ALL {
+            batch.exc = std::current_exception();
+        }
+    }
+
     virtual ExpressionValue
     apply(const FunctionApplier & applier,
           const ExpressionValue & context) const override
@@ -1634,6 +1835,8 @@ struct TensorflowGraphConfig {
     SelectExpression inputs;
     SelectExpression outputs;
     Regex devices = ".*";
+    int maxBatchSize = 1;
+    double maxBatchLatencyMs = 2.0;
 };
 
 
@@ -1657,6 +1860,28 @@ TensorflowGraphConfigDescription()
             "graph is allowed to run.  For example, `.*` means all devices "
             "(CPU and GPU), `/cpu:.*` means CPU only, `/gpu:.*` means GPU "
             "only, `/gpu:[01]` means on the first two GPUs.");
+    addAuto("maxBatchSize", &TensorflowGraphConfig::maxBatchSize,
+            "Maximum number of rows that concurrent calls of the function "
+            "are coalesced into for a single run of the graph.  The inputs "
+            "of the calls are concatenated along their first dimension, "
+            "and the outputs split along theirs, so this can only be used "
+            "with graphs whose first dimension is the batch.  The default "
+            "of 1 runs each call on its own.");
+    addAuto("maxBatchLatencyMs", &TensorflowGraphConfig::maxBatchLatencyMs,
+            "Maximum time in milliseconds that a call waits for others to "
+            "join its batch before the graph is run.  Only used when "
+            "`maxBatchSize` is greater than 1.");
+
+    onPostValidate = [] (TensorflowGraphConfig * cfg,
+                         JsonParsingContext & context)
+        {
+            if (cfg->maxBatchSize < 1) {
+                throw MLDB::Exception("maxBatchSize must be at least 1");
+            }
+            if (!(cfg->maxBatchLatencyMs >= 0)) {
+                throw MLDB::Exception("maxBatchLatencyMs must not be negative");
+            }
+        };
 }
 
 struct TensorflowGraph: public TensorflowGraphBase {
@@ -1691,6 +1916,9 @@ struct TensorflowGraph: public TensorflowGraphBase {
                 (500, "Couldn't load tensorflow graph model: parse error");
         }
 
+        this->maxBatchSize = functionConfig.maxBatchSize;
+        this->maxBatchLatencyMs = functionConfig.maxBatchLatencyMs;
+
         this->init(std::move(graph), functionConfig.inputs, functionConfig.outputs,
                    functionConfig.devices);
 
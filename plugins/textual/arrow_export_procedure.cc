@@ -0,0 +1,161 @@
+/** arrow_export_procedure.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Procedure that exports the output of a query as an Arrow file.
+*/
+
+#include "arrow_export_procedure.h"
+#include "mldb/core/mldb_engine.h"
+#include "mldb/engine/bound_queries.h"
+#include "mldb/engine/dataset_scope.h"
+#include "mldb/sql/arrow_writer.h"
+#include "mldb/sql/table_expression_operations.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/utils/lightweight_hash.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/builtin/sql_config_validator.h"
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+DEFINE_STRUCTURE_DESCRIPTION(ArrowExportProcedureConfig);
+
+ArrowExportProcedureConfigDescription::
+ArrowExportProcedureConfigDescription()
+{
+    addField("exportData", &ArrowExportProcedureConfig::exportData,
+             "An SQL query to select the data to be exported.  This could "
+             "be any query on an existing dataset.");
+    addField("dataFileUrl", &ArrowExportProcedureConfig::dataFileUrl,
+             "URL where the Arrow file should be written to. If a file "
+             "already exists, it will be overwritten.");
+    addField("rowsPerBatch", &ArrowExportProcedureConfig::rowsPerBatch,
+             "Number of rows in each record batch of the file.  The types "
+             "of the columns are chosen from the values of the first "
+             "batch.", 65536);
+
+    addParent<ProcedureConfig>();
+
+    onPostValidate = [&] (ArrowExportProcedureConfig * cfg,
+                          JsonParsingContext & context)
+    {
+        if (cfg->rowsPerBatch < 1)
+            throw MLDB::Exception("rowsPerBatch must be at least 1");
+        MustContainFrom()(cfg->exportData, ArrowExportProcedureConfig::name);
+    };
+}
+
+
+/*****************************************************************************/
+/* ARROW EXPORT PROCEDURE                                                    */
+/*****************************************************************************/
+
+ArrowExportProcedure::
+ArrowExportProcedure(MldbEngine * owner,
+                     PolyConfig config,
+                     const std::function<bool (const Json::Value &)> & onProgress)
+    : Procedure(owner)
+{
+    procedureConfig = config.params.convert<ArrowExportProcedureConfig>();
+}
+
+RunOutput
+ArrowExportProcedure::
+run(const ProcedureRunConfig & run,
+    const std::function<bool (const Json::Value &)> & onProgress) const
+{
+    auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
+    SqlExpressionMldbScope context(engine);
+
+    ConvertProgressToJson convertProgressToJson(onProgress);
+    auto boundDataset = runProcConf.exportData.stm->from->bind(context, convertProgressToJson);
+
+    vector<shared_ptr<SqlExpression> > calc;
+    BoundSelectQuery bsq(runProcConf.exportData.stm->select,
+                         *boundDataset.dataset,
+                         boundDataset.asName,
+                         runProcConf.exportData.stm->when,
+                         *runProcConf.exportData.stm->where,
+                         runProcConf.exportData.stm->orderBy,
+                         calc);
+
+    const auto columnNames = bsq.getSelectOutputInfo()->allAtomNames();
+    LightweightHash<ColumnHash, int> columnIndex;
+    std::vector<ArrowField> fields;
+    for (auto & c: columnNames) {
+        columnIndex[c] = fields.size();
+        fields.push_back({ c.toUtf8String(), ArrowType::NONE });
+    }
+
+    filter_ostream out(runProcConf.dataFileUrl);
+    ArrowWriter writer(std::move(fields),
+                       [&] (std::string data)
+                       {
+                           out.write(data.data(), data.size());
+                       },
+                       true /* fileFormat */,
+                       runProcConf.rowsPerBatch);
+
+    std::vector<const CellValue *> values(columnNames.size());
+
+    auto outputRow = [&] (NamedRowValue & row_,
+                          const vector<ExpressionValue> & calc)
+    {
+        MatrixNamedRow row = row_.flattenDestructive();
+        std::fill(values.begin(), values.end(), nullptr);
+        for (auto & c: row.columns) {
+            auto it = columnIndex.find(std::get<0>(c));
+            if (it == columnIndex.end())
+                throw AnnotatedException
+                    (400, "Column '" + std::get<0>(c).toUtf8String()
+                     + "' of row '" + row.rowName.toUtf8String()
+                     + "' isn't in the output of the query",
+                     "column", std::get<0>(c));
+            if (values[it->second])
+                throw AnnotatedException
+                    (400, "Arrow export does not work over cells having "
+                     "multiple values, at row '" + row.rowName.toUtf8String()
+                     + "' for column '" + std::get<0>(c).toUtf8String() + "'",
+                     "column", std::get<0>(c));
+            values[it->second] = &std::get<1>(c);
+        }
+        writer.addRow(values.data());
+        return true;
+    };
+
+    bsq.execute({outputRow, false/*processInParallel*/},
+                runProcConf.exportData.stm->offset,
+                runProcConf.exportData.stm->limit,
+                convertProgressToJson);
+
+    writer.finish();
+    out.close();
+
+    Json::Value status;
+    status["rowCount"] = writer.rowCount();
+    return Any(status);
+}
+
+Any
+ArrowExportProcedure::
+getStatus() const
+{
+    return Any();
+}
+
+namespace {
+
+RegisterProcedureType<ArrowExportProcedure, ArrowExportProcedureConfig>
+regArrowExportProcedure(
+    builtinPackage(),
+    "Exports the output of a query to a target location as an Arrow file",
+    "procedures/ArrowExportProcedure.md.html");
+
+} // file scope
+
+} // namespace MLDB
@@ -0,0 +1,47 @@
+/** arrow_export_procedure.h                                       -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Procedure that exports the output of a query as an Arrow file.
+*/
+
+#pragma once
+
+#include "mldb/core/procedure.h"
+#include "mldb/core/dataset.h"
+#include "mldb/sql/sql_expression.h"
+
+
+namespace MLDB {
+
+struct ArrowExportProcedureConfig : ProcedureConfig {
+    static constexpr const char * name = "export.arrow";
+
+    InputQuery exportData;
+    Url dataFileUrl;
+    int rowsPerBatch = 65536;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(ArrowExportProcedureConfig);
+
+
+/*****************************************************************************/
+/* ARROW EXPORT PROCEDURE                                                    */
+/*****************************************************************************/
+
+struct ArrowExportProcedure: public Procedure {
+
+    ArrowExportProcedure(
+        MldbEngine * owner,
+        PolyConfig config,
+        const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual RunOutput run(
+        const ProcedureRunConfig & run,
+        const std::function<bool (const Json::Value &)> & onProgress) const;
+
+    virtual Any getStatus() const;
+
+    ArrowExportProcedureConfig procedureConfig;
+};
+
+} // namespace MLDB
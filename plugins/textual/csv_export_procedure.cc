@@ -22,8 +22,11 @@
 #include "mldb/sql/sql_expression.h"
 #include "mldb/vfs/filter_streams.h"
 #include "csv_writer.h"
+#include "mldb/base/thread_pool.h"
 #include "mldb/builtin/sql_config_validator.h"
 #include <memory>
+#include <mutex>
+#include <sstream>
 
 using namespace std;
 
@@ -61,6 +64,31 @@ CsvExportProcedureConfigDescription()
              "    [Built-in Functions](../sql/ValueExpression.md.html) documentation for the\n"
              "    complete list of aggregators.\n\n",
              false);
+    addField("compressionLevel", &CsvExportProcedureConfig::compressionLevel,
+             "Level of compression of the file, when `dataFileUrl` ends in "
+             "the extension of a compression format (like `.gz` or `.zst`).  "
+             "The default of -1 uses the default level of the format.", -1);
+    addField("compressionThreads",
+             &CsvExportProcedureConfig::compressionThreads,
+             "Number of threads used to compress the file.  With more than "
+             "one, the file is written as blocks that are compressed in "
+             "parallel (a multi-member gzip file, multi-frame zstd or lz4 "
+             "file or a multi-stream bzip2 file), which the usual tools "
+             "read as a single file.  The default of 0 uses one thread per "
+             "CPU; 1 compresses the file as a single stream.", 0);
+    addField("numShards", &CsvExportProcedureConfig::numShards,
+             "Number of files to write the output to, so that it can be "
+             "consumed in parallel.  With more than one, the number of "
+             "each file is added to the name of `dataFileUrl` before its "
+             "extensions, so that `part.csv.gz` gives `part-00000.csv.gz`, "
+             "`part-00001.csv.gz` and so on.  Each file has its own header "
+             "line.", 1);
+    addField("ordered", &CsvExportProcedureConfig::ordered,
+             "If true, the rows are written in the order of the query "
+             "(with more than one file, blocks of rows go to each file in "
+             "turn).  If false, the rows are written in whatever order "
+             "they are produced, which is faster since the query can run "
+             "in parallel all the way to the output.", true);
 
     addParent<ProcedureConfig>();
 
@@ -73,6 +101,9 @@ CsvExportProcedureConfigDescription()
         if (cfg->quoteChar.size() != 1) {
             throw MLDB::Exception("Quotechar must be 1 char long.");
         }
+        if (cfg->numShards < 1) {
+            throw MLDB::Exception("numShards must be at least 1.");
+        }
         MustContainFrom()(cfg->exportData, CsvExportProcedureConfig::name);
     };
 }
@@ -86,44 +117,37 @@ CsvExportProcedure(MldbEngine * owner,
     procedureConfig = config.params.convert<CsvExportProcedureConfig>();
 }
 
-RunOutput
-CsvExportProcedure::
-run(const ProcedureRunConfig & run,
-    const std::function<bool (const Json::Value &)> & onProgress) const
-{
-    auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
-    SqlExpressionMldbScope context(engine);
-    filter_ostream out(runProcConf.dataFileUrl);
-    CsvWriter csv(out, runProcConf.delimiter.at(0),
-                  runProcConf.quoteChar.at(0));
+namespace {
 
-    ConvertProgressToJson convertProgressToJson(onProgress);
-    auto boundDataset = runProcConf.exportData.stm->from->bind(context, convertProgressToJson);
+/** Formats rows of the output of the query as lines of the CSV file.  The
+    values of a row can come in a different order than the columns of the
+    file; those that come early are held in lineBuffer until they can be
+    written.  Each thread needs its own, as the line buffer is reused.
+*/
+struct CsvLineFormatter {
+    CsvLineFormatter(const vector<ColumnPath> & columnNames,
+                     bool skipDuplicateCells)
+        : columnNames(columnNames),
+          skipDuplicateCells(skipDuplicateCells),
+          lineBuffer(columnNames.size())
+    {
+    }
 
-    vector<shared_ptr<SqlExpression> > calc;
-    BoundSelectQuery bsq(runProcConf.exportData.stm->select,
-                         *boundDataset.dataset,
-                         boundDataset.asName,
-                         runProcConf.exportData.stm->when,
-                         *runProcConf.exportData.stm->where,
-                         runProcConf.exportData.stm->orderBy,
-                         calc);
-
-    const auto columnNames = bsq.getSelectOutputInfo()->allAtomNames();
+    const vector<ColumnPath> & columnNames;
+    bool skipDuplicateCells;
 
     vector<string> lineBuffer; // keeps the data that cannot be outputed
                                // yet to the csv due to the ordering difference
                                // between columnNames and the order in which
                                // columns are in the bound select query execute
-    const auto lineSize = columnNames.size();
-    lineBuffer.resize(columnNames.size());
-    const auto columnNamesEnd = columnNames.end();
-    const auto columnNamesBegin = columnNames.begin();
-    auto outputCsvLine = [&] (NamedRowValue & row_,
-                              const vector<ExpressionValue> & calc)
+
+    void operator () (NamedRowValue & row_, CsvWriter & csv)
     {
         MatrixNamedRow row = row_.flattenDestructive();
         ExcAssert(lineBuffer.size() == columnNames.size());
+        const auto lineSize = columnNames.size();
+        const auto columnNamesEnd = columnNames.end();
+        const auto columnNamesBegin = columnNames.begin();
         size_t lineBufferIndex = 0; // position of the buffered value ready to
                                     // be outputed
 
@@ -146,7 +170,7 @@ run(const ProcedureRunConfig & run,
                     // column must always be found, otherwise me should be in a
                     // context where cells have multiple values.
                     if (columnNamesIt == columnNamesEnd) {
-                        if(runProcConf.skipDuplicateCells)
+                        if(skipDuplicateCells)
                             return false;
 
                         throw MLDB::Exception(Utf8String("CSV export does not work over "
@@ -205,20 +229,193 @@ run(const ProcedureRunConfig & run,
             outputLineBuffer();
         }
         csv.endl();
-        return true;
-    };
+    }
+};
+
+/** URL of the given shard of the output.  With more than one shard, the
+    shard number is added to the file name before its extensions, so that
+    file://out/part.csv.gz becomes file://out/part-00000.csv.gz and so on.
+*/
+string shardUrl(const Url & url, int shard, int numShards)
+{
+    string result = url.toDecodedString();
+    if (numShards == 1)
+        return result;
+
+    size_t slash = result.rfind('/');
+    size_t dot = result.find('.', slash == string::npos ? 0 : slash + 1);
+    if (dot == string::npos)
+        dot = result.size();
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "-%05d", shard);
+    return result.insert(dot, suffix);
+}
+
+} // file scope
+
+RunOutput
+CsvExportProcedure::
+run(const ProcedureRunConfig & run,
+    const std::function<bool (const Json::Value &)> & onProgress) const
+{
+    /// Number of rows formatted together in ordered mode
+    static constexpr size_t ROWS_PER_BLOCK = 1024;
+
+    /// Size of the output that each thread accumulates before writing it
+    /// in unordered mode
+    static constexpr size_t BYTES_PER_BLOCK = 1024 * 1024;
+
+    auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
+    SqlExpressionMldbScope context(engine);
+    const int numShards = runProcConf.numShards;
+    const char delimiter = runProcConf.delimiter.at(0);
+    const char quoteChar = runProcConf.quoteChar.at(0);
+
+    ConvertProgressToJson convertProgressToJson(onProgress);
+    auto boundDataset = runProcConf.exportData.stm->from->bind(context, convertProgressToJson);
+
+    vector<shared_ptr<SqlExpression> > calc;
+    BoundSelectQuery bsq(runProcConf.exportData.stm->select,
+                         *boundDataset.dataset,
+                         boundDataset.asName,
+                         runProcConf.exportData.stm->when,
+                         *runProcConf.exportData.stm->where,
+                         runProcConf.exportData.stm->orderBy,
+                         calc);
 
+    const auto columnNames = bsq.getSelectOutputInfo()->allAtomNames();
+
+    // Each shard is a complete CSV file, with its own header
+    std::string header;
     if (runProcConf.headers) {
-        for (const auto & name: bsq.getSelectOutputInfo()->allAtomNames()) {
+        std::ostringstream stream;
+        CsvWriter csv(stream, delimiter, quoteChar);
+        for (const auto & name: columnNames) {
             csv << name.toUtf8String();
         }
         csv.endl();
+        header = stream.str();
     }
 
-    bsq.execute({outputCsvLine, false/*processInParallel*/},
-                runProcConf.exportData.stm->offset,
-                runProcConf.exportData.stm->limit,
-                convertProgressToJson);
+    vector<std::unique_ptr<filter_ostream> > outputs;
+    for (int i = 0;  i < numShards;  ++i) {
+        outputs.emplace_back
+            (new filter_ostream
+             (shardUrl(runProcConf.dataFileUrl, i, numShards),
+              { { "compressionLevel",
+                  std::to_string(runProcConf.compressionLevel) },
+                { "compressionThreads",
+                  std::to_string(runProcConf.compressionThreads) } }));
+        *outputs.back() << header;
+    }
+
+    if (runProcConf.ordered) {
+        // Rows come in order on this thread.  They are gathered into
+        // blocks, which are formatted in parallel and then written out in
+        // order, going to the shards in turn.
+        const size_t blocksPerRound = 4 * numCpus();
+        vector<vector<NamedRowValue> > blocks;
+        size_t blocksWritten = 0;
+
+        auto writeBlocks = [&] ()
+            {
+                vector<string> formatted(blocks.size());
+
+                auto formatBlock = [&] (size_t i)
+                    {
+                        std::ostringstream stream;
+                        CsvWriter csv(stream, delimiter, quoteChar);
+                        CsvLineFormatter format(columnNames,
+                                                runProcConf.skipDuplicateCells);
+                        for (auto & row: blocks[i])
+                            format(row, csv);
+                        formatted[i] = stream.str();
+                        blocks[i].clear();
+                    };
+
+                parallelMap(0, blocks.size(), formatBlock);
+
+                for (auto & block: formatted)
+                    *outputs[blocksWritten++ % numShards] << block;
+                blocks.clear();
+            };
+
+        auto onRow = [&] (NamedRowValue & row,
+                          const vector<ExpressionValue> & calc)
+            {
+                if (blocks.empty() || blocks.back().size() == ROWS_PER_BLOCK) {
+                    if (blocks.size() == blocksPerRound)
+                        writeBlocks();
+                    blocks.emplace_back();
+                    blocks.back().reserve(ROWS_PER_BLOCK);
+                }
+                blocks.back().emplace_back(std::move(row));
+                return true;
+            };
+
+        bsq.execute({onRow, false/*processInParallel*/},
+                    runProcConf.exportData.stm->offset,
+                    runProcConf.exportData.stm->limit,
+                    convertProgressToJson);
+        writeBlocks();
+    }
+    else {
+        // Rows are formatted on the threads that produce them, into a
+        // buffer per thread that is written to the next shard whenever
+        // it's big enough.  The order of the lines is undefined.
+        struct ThreadOutput {
+            ThreadOutput(const CsvExportProcedureConfig & config,
+                         const vector<ColumnPath> & columnNames)
+                : csv(stream, config.delimiter.at(0), config.quoteChar.at(0)),
+                  format(columnNames, config.skipDuplicateCells)
+            {
+            }
+
+            std::ostringstream stream;
+            CsvWriter csv;
+            CsvLineFormatter format;
+        };
+
+        PerThreadAccumulator<ThreadOutput> threadOutputs
+            ([&] () { return new ThreadOutput(runProcConf, columnNames); });
+        vector<std::mutex> outputLocks(numShards);
+        std::atomic<size_t> blocksWritten(0);
+
+        auto writeBlock = [&] (ThreadOutput & output)
+            {
+                string block = output.stream.str();
+                output.stream.str(string());
+                if (block.empty())
+                    return;
+                size_t shard = blocksWritten++ % numShards;
+                std::unique_lock<std::mutex> guard(outputLocks[shard]);
+                *outputs[shard] << block;
+            };
+
+        auto onRow = [&] (NamedRowValue & row,
+                          const vector<ExpressionValue> & calc)
+            {
+                ThreadOutput & output = threadOutputs.get();
+                output.format(row, output.csv);
+                if (output.stream.tellp() >= (std::streamoff)BYTES_PER_BLOCK)
+                    writeBlock(output);
+                return true;
+            };
+
+        bsq.execute({onRow, true/*processInParallel*/},
+                    runProcConf.exportData.stm->offset,
+                    runProcConf.exportData.stm->limit,
+                    convertProgressToJson);
+
+        threadOutputs.forEach([&] (ThreadOutput * output)
+                              {
+                                  writeBlock(*output);
+                              });
+    }
+
+    for (auto & out: outputs)
+        out->close();
+
     RunOutput output;
     return output;
 }
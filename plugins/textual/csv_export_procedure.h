@@ -16,7 +16,9 @@ namespace MLDB {
 struct CsvExportProcedureConfig : ProcedureConfig {
     CsvExportProcedureConfig()
         : headers(true), skipDuplicateCells(false),
-          delimiter(","), quoteChar("\"")
+          delimiter(","), quoteChar("\""),
+          compressionLevel(-1), compressionThreads(0),
+          numShards(1), ordered(true)
     {
     }
 
@@ -28,6 +30,10 @@ struct CsvExportProcedureConfig : ProcedureConfig {
     bool skipDuplicateCells;
     std::string delimiter;
     std::string quoteChar;
+    int compressionLevel;
+    int compressionThreads;
+    int numShards;
+    bool ordered;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(CsvExportProcedureConfig);
@@ -0,0 +1,168 @@
+/** csv_structure.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Structural index of a line of CSV.
+*/
+
+#include "csv_structure.h"
+#include "mldb/arch/simd.h"
+
+#if MLDB_INTEL_ISA
+# include <emmintrin.h>
+#endif
+
+
+namespace MLDB {
+
+namespace {
+
+typedef void (*IndexCsvBlocksFn) (const char * data, size_t numBlocks,
+                                  char separator, char quote,
+                                  uint64_t * separators, uint64_t * quotes,
+                                  uint64_t * nonAscii);
+
+/// Set the bits for count characters, which need not be a whole block
+void indexCsvGeneric(const char * data, size_t count,
+                     char separator, char quote,
+                     uint64_t * separators, uint64_t * quotes,
+                     uint64_t * nonAscii)
+{
+    for (size_t i = 0;  i < count;  ++i) {
+        uint64_t bit = 1ULL << (i % 64);
+        char c = data[i];
+        if (c == separator)
+            separators[i / 64] |= bit;
+        if (c == quote)
+            quotes[i / 64] |= bit;
+        if (c & 0x80)
+            nonAscii[i / 64] |= bit;
+    }
+}
+
+#if MLDB_INTEL_ISA
+
+inline uint64_t movemask64(__m128i v0, __m128i v1, __m128i v2, __m128i v3)
+{
+    return (uint64_t)(uint16_t)_mm_movemask_epi8(v0)
+        | ((uint64_t)(uint16_t)_mm_movemask_epi8(v1) << 16)
+        | ((uint64_t)(uint16_t)_mm_movemask_epi8(v2) << 32)
+        | ((uint64_t)(uint16_t)_mm_movemask_epi8(v3) << 48);
+}
+
+void indexCsvBlocksSse2(const char * data, size_t numBlocks,
+                        char separator, char quote,
+                        uint64_t * separators, uint64_t * quotes,
+                        uint64_t * nonAscii)
+{
+    const __m128i sep = _mm_set1_epi8(separator);
+    const __m128i quo = _mm_set1_epi8(quote);
+
+    for (size_t i = 0;  i < numBlocks;  ++i, data += 64) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)data);
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(data + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(data + 32));
+        __m128i v3 = _mm_loadu_si128((const __m128i *)(data + 48));
+
+        separators[i] = movemask64(_mm_cmpeq_epi8(v0, sep),
+                                   _mm_cmpeq_epi8(v1, sep),
+                                   _mm_cmpeq_epi8(v2, sep),
+                                   _mm_cmpeq_epi8(v3, sep));
+        quotes[i] = movemask64(_mm_cmpeq_epi8(v0, quo),
+                               _mm_cmpeq_epi8(v1, quo),
+                               _mm_cmpeq_epi8(v2, quo),
+                               _mm_cmpeq_epi8(v3, quo));
+        // The top bit of each character is set if it's outside of ASCII
+        nonAscii[i] = movemask64(v0, v1, v2, v3);
+    }
+}
+
+#else // MLDB_INTEL_ISA
+
+void indexCsvBlocksGeneric(const char * data, size_t numBlocks,
+                           char separator, char quote,
+                           uint64_t * separators, uint64_t * quotes,
+                           uint64_t * nonAscii)
+{
+    for (size_t i = 0;  i < numBlocks;  ++i) {
+        separators[i] = quotes[i] = nonAscii[i] = 0;
+    }
+    indexCsvGeneric(data, numBlocks * 64, separator, quote,
+                    separators, quotes, nonAscii);
+}
+
+#endif // MLDB_INTEL_ISA
+
+IndexCsvBlocksFn getIndexCsvBlocks()
+{
+#if MLDB_INTEL_ISA
+    if (has_avx2())
+        return Avx2::indexCsvBlocks;
+    return indexCsvBlocksSse2;
+#else
+    return indexCsvBlocksGeneric;
+#endif
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* CSV LINE INDEX                                                            */
+/*****************************************************************************/
+
+void
+CsvLineIndex::
+index(const char * line, size_t length, char separator, char quote)
+{
+    static const IndexCsvBlocksFn indexCsvBlocks = getIndexCsvBlocks();
+
+    this->length = length;
+    numWords = (length + 63) / 64;
+    if (separators.size() < numWords) {
+        separators.resize(numWords);
+        quotes.resize(numWords);
+        nonAscii.resize(numWords);
+    }
+
+    size_t numBlocks = length / 64;
+    indexCsvBlocks(line, numBlocks, separator, quote,
+                   separators.data(), quotes.data(), nonAscii.data());
+
+    if (numBlocks < numWords) {
+        separators[numBlocks] = quotes[numBlocks] = nonAscii[numBlocks] = 0;
+        indexCsvGeneric(line + numBlocks * 64, length % 64, separator, quote,
+                        separators.data() + numBlocks,
+                        quotes.data() + numBlocks,
+                        nonAscii.data() + numBlocks);
+    }
+
+    uint64_t allNonAscii = 0;
+    for (size_t i = 0;  i < numWords;  ++i)
+        allNonAscii |= nonAscii[i];
+    anyNonAscii = allNonAscii != 0;
+}
+
+bool
+CsvLineIndex::
+hasNonAscii(size_t start, size_t end) const
+{
+    if (!anyNonAscii || start >= end)
+        return false;
+
+    size_t startWord = start / 64, endWord = (end - 1) / 64;
+    uint64_t startMask = ~0ULL << (start % 64);
+    uint64_t endMask = ~0ULL >> (63 - (end - 1) % 64);
+
+    if (startWord == endWord)
+        return nonAscii[startWord] & startMask & endMask;
+
+    if (nonAscii[startWord] & startMask)
+        return true;
+    for (size_t i = startWord + 1;  i < endWord;  ++i) {
+        if (nonAscii[i])
+            return true;
+    }
+    return nonAscii[endWord] & endMask;
+}
+
+} // namespace MLDB
@@ -0,0 +1,97 @@
+/** csv_structure.h                                                -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Structural index of a line of CSV, which finds the separators, quotes
+    and non-ASCII characters of the line with SIMD instructions so that
+    the fields can be parsed without looking at each character in turn.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* CSV LINE INDEX                                                            */
+/*****************************************************************************/
+
+/** Bitmaps with one bit per character of a line of CSV, saying whether
+    that character is the separator, whether it's the quote character and
+    whether it's outside of ASCII.  Bit i of word i / 64 is for the
+    character at offset i.
+
+    The index is kept between lines so that it doesn't need to allocate
+    memory for each one.
+*/
+
+struct CsvLineIndex {
+
+    /** Index the given line.  This uses AVX2 if the CPU has it, and SSE2
+        otherwise, for all but the last (length % 64) characters.
+    */
+    void index(const char * line, size_t length, char separator, char quote);
+
+    /// Offset of the first separator at or after pos, or the length of
+    /// the line if there is none.
+    size_t nextSeparator(size_t pos) const
+    {
+        return nextBit(separators.data(), pos);
+    }
+
+    /// Offset of the first quote character at or after pos, or the length
+    /// of the line if there is none.
+    size_t nextQuote(size_t pos) const
+    {
+        return nextBit(quotes.data(), pos);
+    }
+
+    /// Is any of the characters from start up to end outside of ASCII?
+    bool hasNonAscii(size_t start, size_t end) const;
+
+    /// Length of the line that was indexed
+    size_t length = 0;
+
+    /// Number of words of each bitmap that are used for the line
+    size_t numWords = 0;
+
+    /// Is any character of the line outside of ASCII?
+    bool anyNonAscii = false;
+
+    std::vector<uint64_t> separators;
+    std::vector<uint64_t> quotes;
+    std::vector<uint64_t> nonAscii;
+
+private:
+    size_t nextBit(const uint64_t * bitmap, size_t pos) const
+    {
+        if (pos >= length)
+            return length;
+        size_t word = pos / 64;
+        uint64_t bits = bitmap[word] & (~0ULL << (pos % 64));
+        while (!bits) {
+            if (++word == numWords)
+                return length;
+            bits = bitmap[word];
+        }
+        return word * 64 + __builtin_ctzll(bits);
+    }
+};
+
+
+namespace Avx2 {
+
+/// Fill in the bitmaps for numBlocks blocks of 64 characters.  Internal to
+/// csv_structure.cc, and only to be called if the CPU has AVX2.
+void indexCsvBlocks(const char * data, size_t numBlocks,
+                    char separator, char quote,
+                    uint64_t * separators, uint64_t * quotes,
+                    uint64_t * nonAscii);
+
+} // namespace Avx2
+
+} // namespace MLDB
@@ -0,0 +1,43 @@
+/** csv_structure_avx2.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Structural index of a line of CSV; AVX2 version.  This file is compiled
+    with -mavx2, so nothing in it may be called unless the CPU has AVX2.
+*/
+
+#include "csv_structure.h"
+#include <immintrin.h>
+
+
+namespace MLDB {
+namespace Avx2 {
+
+static inline uint64_t movemask64(__m256i lo, __m256i hi)
+{
+    return (uint64_t)(uint32_t)_mm256_movemask_epi8(lo)
+        | ((uint64_t)(uint32_t)_mm256_movemask_epi8(hi) << 32);
+}
+
+void indexCsvBlocks(const char * data, size_t numBlocks,
+                    char separator, char quote,
+                    uint64_t * separators, uint64_t * quotes,
+                    uint64_t * nonAscii)
+{
+    const __m256i sep = _mm256_set1_epi8(separator);
+    const __m256i quo = _mm256_set1_epi8(quote);
+
+    for (size_t i = 0;  i < numBlocks;  ++i, data += 64) {
+        __m256i lo = _mm256_loadu_si256((const __m256i *)data);
+        __m256i hi = _mm256_loadu_si256((const __m256i *)(data + 32));
+
+        separators[i] = movemask64(_mm256_cmpeq_epi8(lo, sep),
+                                   _mm256_cmpeq_epi8(hi, sep));
+        quotes[i] = movemask64(_mm256_cmpeq_epi8(lo, quo),
+                               _mm256_cmpeq_epi8(hi, quo));
+        // The top bit of each character is set if it's outside of ASCII
+        nonAscii[i] = movemask64(lo, hi);
+    }
+}
+
+} // namespace Avx2
+} // namespace MLDB
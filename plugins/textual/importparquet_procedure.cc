@@ -0,0 +1,474 @@
+/** importparquet_procedure.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Procedure that reads Parquet files into a dataset.
+*/
+
+#include "importparquet_procedure.h"
+#include "parquet_reader.h"
+#include "sql_csv_scope.h"
+#include "mldb/arch/timers.h"
+#include "mldb/base/parallel.h"
+#include "mldb/core/mldb_engine.h"
+#include "mldb/engine/dataset_scope.h"
+#include "mldb/plugins/tabular/zone_map.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/utils/progress.h"
+#include "mldb/utils/log.h"
+#include <cmath>
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+DEFINE_STRUCTURE_DESCRIPTION(ImportParquetConfig);
+
+ImportParquetConfigDescription::ImportParquetConfigDescription()
+{
+    addField("dataFileUrl", &ImportParquetConfig::dataFileUrl,
+             "URL of the Parquet file to import");
+    addField("outputDataset", &ImportParquetConfig::outputDataset,
+             "Dataset to record the data into.",
+             PolyConfigT<Dataset>().withType("tabular"));
+    addField("limit", &ImportParquetConfig::limit,
+             "Maximum number of rows of the file to process.  Rows that "
+             "are filtered out by the `where` clause contribute to the "
+             "limit.", int64_t(-1));
+    addField("offset", &ImportParquetConfig::offset,
+             "Skip the first n rows of the file.", int64_t(0));
+    addField("binaryAsString", &ImportParquetConfig::binaryAsString,
+             "If true, binary columns with no annotation are imported as "
+             "strings rather than blobs.  Some older writers don't mark "
+             "string columns as such.", false);
+    addField("select", &ImportParquetConfig::select,
+             "Which columns to use.  Only the columns used by the `select`, "
+             "`where`, `named` and `timestamp` expressions are decoded.",
+             SelectExpression::STAR);
+    addField("where", &ImportParquetConfig::where,
+             "Which rows to use.  Row groups that the statistics in the "
+             "file show can't match are skipped without being read.",
+             SqlExpression::TRUE);
+    addField("named", &ImportParquetConfig::named,
+             "Row name expression for output dataset. Note that each row "
+             "must have a unique name.",
+             SqlExpression::parse("lineNumber()"));
+    addField("timestamp", &ImportParquetConfig::timestamp,
+             "Expression for row timestamp.",
+             SqlExpression::parse("fileTimestamp()"));
+    addParent<ProcedureConfig>();
+}
+
+
+/*****************************************************************************/
+/* ROW GROUP PRUNING                                                         */
+/*****************************************************************************/
+
+namespace {
+
+/** A term of the WHERE clause of the form "column op constant", which can
+    be tested against the statistics of each row group.  The op may also
+    be "IS NULL" or "IS NOT NULL", or "IN" with the values in constants.
+*/
+struct RowGroupConstraint {
+    int columnIndex = -1;
+    std::string op;
+    CellValue constant;
+    std::vector<CellValue> constants;
+
+    bool mayMatch(const ColumnZoneMap & zoneMap) const
+    {
+        if (op != "IN")
+            return zoneMap.mayMatch(op, constant);
+        for (auto & c: constants) {
+            if (zoneMap.mayMatch("=", c))
+                return true;
+        }
+        return false;
+    }
+};
+
+/** Extract the terms of the top-level conjunction of the WHERE clause
+    that can be tested against the row group statistics.  Terms that
+    can't are ignored; they are still evaluated for each row of the row
+    groups that are read.
+*/
+void getRowGroupConstraints(const SqlExpression & where,
+                            const std::map<ColumnPath, int> & columnIndex,
+                            std::vector<RowGroupConstraint> & constraints)
+{
+    if (auto boolean
+        = dynamic_cast<const BooleanOperatorExpression *>(&where)) {
+        if (boolean->op == "AND" && boolean->lhs && boolean->rhs) {
+            getRowGroupConstraints(*boolean->lhs, columnIndex, constraints);
+            getRowGroupConstraints(*boolean->rhs, columnIndex, constraints);
+        }
+        return;
+    }
+
+    auto initConstraint = [&] (const SqlExpression & var,
+                               const std::string & op,
+                               RowGroupConstraint & result)
+        {
+            auto readColumn = dynamic_cast<const ReadColumnExpression *>(&var);
+            if (!readColumn)
+                return false;
+            auto it = columnIndex.find(readColumn->columnName);
+            if (it == columnIndex.end())
+                return false;
+            result.columnIndex = it->second;
+            result.op = op;
+            return true;
+        };
+
+    auto addConstraint = [&] (const SqlExpression & var,
+                              const std::string & op,
+                              const SqlExpression & constant)
+        {
+            auto readConstant
+                = dynamic_cast<const ConstantExpression *>(&constant);
+            if (!readConstant || !readConstant->constant.isAtom())
+                return;
+            RowGroupConstraint result;
+            if (!initConstraint(var, op, result))
+                return;
+            result.constant = readConstant->constant.getAtom();
+            constraints.emplace_back(std::move(result));
+        };
+
+    if (auto comparison = dynamic_cast<const ComparisonExpression *>(&where)) {
+        // Same comparison with the operands swapped
+        static const std::map<std::string, std::string> flipped = {
+            { "=", "=" }, { "==", "==" }, { "<", ">" },
+            { "<=", ">=" }, { ">", "<" }, { ">=", "<=" } };
+        auto it = flipped.find(comparison->op);
+        if (it == flipped.end())
+            return;
+        addConstraint(*comparison->lhs, comparison->op, *comparison->rhs);
+        addConstraint(*comparison->rhs, it->second, *comparison->lhs);
+    }
+    else if (auto between = dynamic_cast<const BetweenExpression *>(&where)) {
+        if (between->notBetween)
+            return;
+        addConstraint(*between->expr, ">=", *between->lower);
+        addConstraint(*between->expr, "<=", *between->upper);
+    }
+    else if (auto in = dynamic_cast<const InExpression *>(&where)) {
+        if (in->isNegative || !in->tuple || !in->tuple->isConstant())
+            return;
+        RowGroupConstraint result;
+        if (!initConstraint(*in->expr, "IN", result))
+            return;
+        for (auto & c: in->tuple->clauses) {
+            ExpressionValue val = c->constantValue();
+            if (!val.isAtom())
+                return;
+            result.constants.emplace_back(val.getAtom());
+        }
+        constraints.emplace_back(std::move(result));
+    }
+    else if (auto isType = dynamic_cast<const IsTypeExpression *>(&where)) {
+        if (isType->type != "null")
+            return;
+        RowGroupConstraint result;
+        if (!initConstraint(*isType->expr,
+                            isType->notType ? "IS NOT NULL" : "IS NULL",
+                            result))
+            return;
+        constraints.emplace_back(std::move(result));
+    }
+}
+
+/** Turn the statistics of a column chunk into a zone map, which knows
+    how to test them against a constraint.
+*/
+ColumnZoneMap getZoneMap(const ParquetFile & file,
+                         const ParquetRowGroup & group,
+                         int column)
+{
+    const ParquetColumnChunk & chunk
+        = group.columns.at(file.columns.at(column).chunkIndex);
+
+    // Without a null count, there may be both nulls and values
+    ColumnZoneMap result;
+    result.numNulls = chunk.hasNullCount ? chunk.nullCount : group.numRows;
+    result.numNonNull = group.numRows
+        - (chunk.hasNullCount ? chunk.nullCount : 0);
+
+    if (chunk.hasMinMax) {
+        try {
+            result.minValue = file.decodeStatistic(column, chunk.minValue);
+            result.maxValue = file.decodeStatistic(column, chunk.maxValue);
+            auto isNan = [] (const CellValue & v)
+                {
+                    return v.isNumber() && std::isnan(v.toDouble());
+                };
+            result.hasRange = !isNan(result.minValue)
+                && !isNan(result.maxValue);
+        } catch (const std::exception & exc) {
+            // Statistics we can't read don't prune anything
+            result.hasRange = false;
+        }
+    }
+
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* IMPORT PARQUET PROCEDURE                                                  */
+/*****************************************************************************/
+
+ImportParquetProcedure::
+ImportParquetProcedure(MldbEngine * owner,
+                       PolyConfig config,
+                       const std::function<bool (const Json::Value &)> & onProgress)
+    : Procedure(owner)
+{
+    this->config = config.params.convert<ImportParquetConfig>();
+}
+
+Any
+ImportParquetProcedure::
+getStatus() const
+{
+    return Any();
+}
+
+RunOutput
+ImportParquetProcedure::
+run(const ProcedureRunConfig & run,
+    const std::function<bool (const Json::Value &)> & onProgress) const
+{
+    auto runProcConf = applyRunConfOverProcConf(config, run);
+
+    std::shared_ptr<Dataset> dataset
+        = createDataset(engine, runProcConf.outputDataset, onProgress,
+                        true /*overwrite*/);
+
+    // Parquet files need random access, so ask for a memory mappable
+    // stream, and read it all into memory if it's not
+    filter_istream stream(runProcConf.dataFileUrl, { { "mapped", "true" },
+                                                     { "compression", "none" } });
+    Date ts = stream.info().lastModified;
+
+    std::string contents;
+    const char * data;
+    size_t length;
+    std::tie(data, length) = stream.mapped();
+    if (!data) {
+        contents.assign(std::istreambuf_iterator<char>(stream),
+                        std::istreambuf_iterator<char>());
+        data = contents.data();
+        length = contents.size();
+    }
+
+    ParquetFile file(data, length, runProcConf.binaryAsString);
+
+    // The input columns are the flat columns of the file
+    std::vector<ColumnPath> inputColumnNames;
+    std::vector<int> fileColumns;
+    std::map<ColumnPath, int> inputColumnIndex;
+    for (size_t i = 0;  i < file.columns.size();  ++i) {
+        const ParquetColumn & column = file.columns[i];
+        if (!column.isFlat) {
+            WARNING_MSG(logger) << "skipping nested or repeated Parquet "
+                                << "column " << column.name;
+            continue;
+        }
+        inputColumnIndex[ColumnPath(column.name)] = inputColumnNames.size();
+        inputColumnNames.emplace_back(column.name);
+        fileColumns.push_back(i);
+    }
+
+    SqlCsvScope scope(engine, inputColumnNames, ts,
+                      Utf8String(runProcConf.dataFileUrl.toDecodedString()));
+
+    BoundSqlExpression selectBound = runProcConf.select.bind(scope);
+    BoundSqlExpression whereBound = runProcConf.where->bind(scope);
+    BoundSqlExpression namedBound = runProcConf.named->bind(scope);
+    BoundSqlExpression timestampBound = runProcConf.timestamp->bind(scope);
+
+    // Do we have a "select *"?  In that case, we can record the values
+    // directly without calling into the SQL layer
+    SqlExpressionDatasetScope noContext(*dataset, "");
+    bool isIdentitySelect = runProcConf.select.isIdentitySelect(noContext);
+    bool isWhereTrue = runProcConf.where->isConstantTrue();
+    bool isNamedLineNumber = runProcConf.named->surface == "lineNumber()";
+
+    std::vector<RowGroupConstraint> constraints;
+    getRowGroupConstraints(*runProcConf.where, inputColumnIndex, constraints);
+
+    // Work out which row groups need to be read
+    int64_t firstRow = runProcConf.offset;
+    int64_t lastRow = runProcConf.limit < 0
+        ? file.numRows : std::min(file.numRows, firstRow + runProcConf.limit);
+
+    std::vector<size_t> rowGroups;
+    for (size_t i = 0;  i < file.rowGroups.size();  ++i) {
+        const ParquetRowGroup & group = file.rowGroups[i];
+        if (group.firstRow + group.numRows <= firstRow
+            || group.firstRow >= lastRow)
+            continue;
+
+        bool mayMatch = true;
+        for (auto & c: constraints) {
+            if (!c.mayMatch(getZoneMap(file, group, fileColumns[c.columnIndex]))) {
+                mayMatch = false;
+                break;
+            }
+        }
+        if (mayMatch)
+            rowGroups.push_back(i);
+    }
+
+    size_t numColumnsUsed = 0;
+    for (auto used: scope.columnsUsed)
+        numColumnsUsed += used;
+
+    INFO_MSG(logger)
+        << "reading " << numColumnsUsed << " of " << inputColumnNames.size()
+        << " columns from " << rowGroups.size() << " of "
+        << file.rowGroups.size() << " row groups";
+
+    Progress progress;
+    std::shared_ptr<Step> iterationStep = progress.steps({
+        make_pair("iterating", "rows"),
+    });
+    std::mutex progressMutex;
+
+    Timer timer;
+    std::atomic<uint64_t> rowsDone(0);
+    std::atomic<uint64_t> rowCount(0);
+
+    Dataset::MultiChunkRecorder recorder = dataset->getChunkRecorder();
+
+    auto doRowGroup = [&] (size_t n)
+        {
+            size_t groupNum = rowGroups[n];
+            const ParquetRowGroup & group = file.rowGroups[groupNum];
+
+            // Range of rows of the group within the offset and limit
+            int64_t begin = std::max<int64_t>(0, firstRow - group.firstRow);
+            int64_t end = std::min(group.numRows, lastRow - group.firstRow);
+
+            // Only decode the columns that are used
+            std::vector<std::vector<CellValue> > columnValues
+                (inputColumnNames.size());
+            for (size_t i = 0;  i < inputColumnNames.size();  ++i) {
+                if (scope.columnsUsed[i])
+                    columnValues[i] = file.readColumn(groupNum, fileColumns[i]);
+            }
+
+            std::unique_ptr<Recorder> threadRecorder = recorder.newChunk(n);
+            std::function<void (RowPath rowName,
+                                Date timestamp,
+                                CellValue * vals,
+                                size_t numVals,
+                                std::vector<std::pair<ColumnPath, CellValue> > extra)>
+                specializedRecorder;
+            if (isIdentitySelect)
+                specializedRecorder
+                    = threadRecorder->specializeRecordTabular(inputColumnNames);
+
+            std::vector<CellValue> values(inputColumnNames.size());
+            uint64_t numRecorded = 0;
+
+            for (int64_t r = begin;  r < end;  ++r) {
+                for (size_t i = 0;  i < values.size();  ++i) {
+                    if (scope.columnsUsed[i])
+                        values[i] = std::move(columnValues[i][r]);
+                }
+
+                int64_t rowNumber = group.firstRow + r + 1;
+                auto row = scope.bindRow(values.data(), ts, rowNumber,
+                                         0 /* lineOffset */);
+
+                ExpressionValue nameStorage;
+                RowPath rowName;
+                if (isNamedLineNumber)
+                    rowName = Path(rowNumber);
+                else rowName = namedBound(row, nameStorage, GET_ALL)
+                         .coerceToPath();
+                row.rowName = &rowName;
+
+                if (!isWhereTrue) {
+                    ExpressionValue storage;
+                    if (!whereBound(row, storage, GET_ALL).isTrue())
+                        continue;
+                }
+
+                ExpressionValue tsStorage;
+                Date rowTs = timestampBound(row, tsStorage, GET_ALL)
+                    .coerceToTimestamp().toTimestamp();
+
+                if (isIdentitySelect) {
+                    specializedRecorder(std::move(rowName), rowTs,
+                                        values.data(), values.size(), {});
+                }
+                else {
+                    ExpressionValue selectStorage;
+                    const ExpressionValue & selectOutput
+                        = selectBound(row, selectStorage, GET_ALL);
+
+                    if (&selectOutput == &selectStorage) {
+                        threadRecorder->recordRowExprDestructive
+                            (std::move(rowName), std::move(selectStorage));
+                    }
+                    else {
+                        threadRecorder->recordRowExpr(std::move(rowName),
+                                                      selectOutput);
+                    }
+                }
+                ++numRecorded;
+            }
+
+            threadRecorder->finishedChunk();
+
+            rowCount += numRecorded;
+            uint64_t done = rowsDone += end - begin;
+
+            std::unique_lock<std::mutex> guard(progressMutex);
+            iterationStep->updateValue(done);
+            onProgress(jsonEncode(iterationStep));
+        };
+
+    parallelMap(0, rowGroups.size(), doRowGroup);
+
+    recorder.commit();
+
+    double wall = timer.elapsed_wall();
+    INFO_MSG(logger)
+        << "imported " << rowCount << " of " << rowsDone << " rows in "
+        << wall << "s at " << rowsDone / wall * 0.000001
+        << "M rows/second on "
+        << timer.elapsed_cpu() / timer.elapsed_wall() << " CPUs";
+
+    Json::Value status;
+    status["rowCount"] = rowCount.load();
+    status["numRowGroups"] = file.rowGroups.size();
+    status["numRowGroupsSkipped"] = file.rowGroups.size() - rowGroups.size();
+
+    dataset->commit();
+
+    return Any(status);
+}
+
+namespace {
+
+RegisterProcedureType<ImportParquetProcedure, ImportParquetConfig>
+regImportParquet(builtinPackage(),
+                 "Import from a Parquet file.",
+                 "procedures/ParquetImporter.md.html");
+
+} // file scope
+
+} // namespace MLDB
@@ -0,0 +1,62 @@
+/** importparquet_procedure.h                                      -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Procedure that reads Parquet files into a dataset.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/core/procedure.h"
+#include "mldb/sql/sql_expression.h"
+
+
+namespace MLDB {
+
+
+struct ImportParquetConfig : public ProcedureConfig  {
+    static constexpr const char * name = "import.parquet";
+
+    Url dataFileUrl;
+    PolyConfigT<Dataset> outputDataset = DefaultType("tabular");
+    int64_t limit = -1;
+    int64_t offset = 0;
+    bool binaryAsString = false;
+
+    /// What to select from the file
+    SelectExpression select = SelectExpression::STAR;
+
+    /// Filter for the rows
+    std::shared_ptr<SqlExpression> where = SqlExpression::TRUE;
+
+    ///< Row name to output
+    std::shared_ptr<SqlExpression> named
+        = SqlExpression::parse("lineNumber()");
+
+    ///< Timestamp for row
+    std::shared_ptr<SqlExpression> timestamp
+        = SqlExpression::parse("fileTimestamp()");
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(ImportParquetConfig);
+
+
+/*****************************************************************************/
+/* IMPORT PARQUET PROCEDURE                                                  */
+/*****************************************************************************/
+
+struct ImportParquetProcedure: public Procedure {
+
+    ImportParquetProcedure(MldbEngine * owner,
+                           PolyConfig config,
+                           const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual RunOutput run(const ProcedureRunConfig & run,
+                          const std::function<bool (const Json::Value &)> & onProgress) const;
+
+    virtual Any getStatus() const;
+
+    ImportParquetConfig config;
+};
+
+} // namespace MLDB
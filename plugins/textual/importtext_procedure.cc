@@ -16,8 +16,10 @@
 #include "mldb/base/per_thread_accumulator.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/map_description.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/engine/dataset_scope.h"
+#include "mldb/engine/procedure_checkpoint.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/utils/progress.h"
@@ -25,6 +27,7 @@
 #include "mldb/utils/log.h"
 #include "mldb/utils/possibly_dynamic_buffer.h"
 #include "sql_csv_scope.h"
+#include "csv_structure.h"
 #include "mldb/base/parse_context.h"
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/base/optimized_path.h"
@@ -35,6 +38,24 @@ using namespace std;
 
 namespace MLDB {
 
+DEFINE_ENUM_DESCRIPTION(ImportTextColumnType);
+
+ImportTextColumnTypeDescription::
+ImportTextColumnTypeDescription()
+{
+    addValue("auto", COLUMN_TYPE_AUTO,
+             "Values that look like numbers are numbers, and the rest "
+             "are strings");
+    addValue("integer", COLUMN_TYPE_INTEGER,
+             "Values are integers; anything else is an error");
+    addValue("number", COLUMN_TYPE_NUMBER,
+             "Values are floating point numbers; anything else is an error");
+    addValue("timestamp", COLUMN_TYPE_TIMESTAMP,
+             "Values are ISO 8601 timestamps; anything else is an error");
+    addValue("string", COLUMN_TYPE_STRING,
+             "Values are strings, including those that look like numbers");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(ImportTextConfig);
 
 ImportTextConfigDescription::ImportTextConfigDescription()
@@ -99,6 +120,13 @@ ImportTextConfigDescription::ImportTextConfigDescription()
              "If true, the indexes of the columns will be used to name them."
              "This cannot be set to true if headers is defined.",
              false);
+    addAuto("columnTypes", &ImportTextConfig::columnTypes,
+            "Types of the columns of the file, as a map from column name "
+            "to one of 'auto', 'integer', 'number', 'timestamp' or "
+            "'string'.  Values of typed columns are parsed straight into "
+            "that type, which is faster than detecting the type of each "
+            "one; a value that doesn't parse as its column's type is an "
+            "error for its line.  Columns that aren't listed are 'auto'.");
     addAuto("ignoreExtraColumns", &ImportTextConfig::ignoreExtraColumns,
             "Ignore extra columns that weren't in header.  This allows for files that "
             "have optional trailing columns that aren't listed in the header or for "
@@ -198,6 +226,62 @@ const char * findInvalidAscii(const char * start, size_t length, char*buf, char
     return buf;
 }
 
+/** Parse a value of a column with a declared type, without looking at
+    what else it could be.  Returns a null value and sets errorMsg if the
+    value isn't of the type.  Empty values are null.
+*/
+CellValue parseTypedValue(const char * start, size_t len,
+                          ImportTextColumnType type,
+                          const char * & errorMsg)
+{
+    if (len == 0)
+        return CellValue();
+
+    switch (type) {
+    case COLUMN_TYPE_INTEGER: {
+        const char * p = start;
+        const char * end = start + len;
+        bool negative = *p == '-';
+        if (negative || *p == '+')
+            ++p;
+        uint64_t num = 0;
+        bool ok = p < end;
+        for (; ok && p < end;  ++p) {
+            unsigned digit = *p - '0';
+            ok = digit < 10
+                && num <= (std::numeric_limits<uint64_t>::max() - digit) / 10;
+            num = 10 * num + digit;
+        }
+        if (ok && !negative)
+            return CellValue(num);
+        if (ok && num <= (uint64_t)1 << 63)
+            return CellValue((int64_t)(0 - num));
+        errorMsg = "value is not an integer";
+        return CellValue();
+    }
+    case COLUMN_TYPE_NUMBER: {
+        char buf[len + 1];
+        memcpy(buf, start, len);
+        buf[len] = 0;
+        char * end;
+        double val = strtod(buf, &end);
+        if (end == buf + len && !isspace(buf[0]))
+            return CellValue(val);
+        errorMsg = "value is not a number";
+        return CellValue();
+    }
+    case COLUMN_TYPE_TIMESTAMP: {
+        Date date = Date::parseIso8601DateTime(start, len);
+        if (date.isADate())
+            return CellValue(date);
+        errorMsg = "value is not an ISO 8601 timestamp";
+        return CellValue();
+    }
+    default:
+        throw MLDB::Exception("parseTypedValue: not a parsed type");
+    }
+}
+
 } // file scope
 
 namespace {
@@ -236,6 +320,11 @@ MLDB_ALWAYS_INLINE bool isascii(int c)
     Otherwise, it's the ASCII code point to put in place of them.
     - isTextLine: optimization to ignore separator and quote chars and get a single column per line
     - hasQuoteChar: should we use the quote char
+    - index: structural index, which is filled in for the line and used
+    to find the end of each field without looking at each character
+    - columnTypes: declared type of each column, or empty if none are
+    declared.  Values of typed columns are parsed straight into their
+    type rather than having it detected.
 */
 
 const char *
@@ -252,7 +341,9 @@ parseFixedWidthCsvRow(const char * & line,
                       const shared_ptr<spdlog::logger> & logger,
                       bool ignoreExtraColumns,
                       bool processExcelFormulas,
-                      const std::vector<int> & columnIsUsed)
+                      const std::vector<int> & columnIsUsed,
+                      CsvLineIndex & index,
+                      const std::vector<ImportTextColumnType> & columnTypes)
 {
     ExcAssert(!(hasQuoteChar && isTextLine));
 
@@ -261,13 +352,37 @@ parseFixedWidthCsvRow(const char * & line,
     while (length > 0 && isspace(line[length - 1]))
         --length;
     
+    const char * lineStart = line;
     const char * lineEnd = line + length;
 
+    index.index(line, length, separator, quote);
+
+    // End of the unquoted field that contains the given character, which
+    // is either a separator or the end of the line
+    auto fieldEnd = [&] (const char * p) -> const char *
+        {
+            if (isTextLine)
+                return lineEnd;
+            return lineStart + index.nextSeparator(p - lineStart);
+        };
+
+    auto hasNonAscii = [&] (const char * start, const char * end)
+        {
+            return index.hasNonAscii(start - lineStart, end - lineStart);
+        };
+
     const char * errorMsg = nullptr;
 
     size_t colNum = 0;
 
-    auto finishString = [encoding,replaceInvalidCharactersWith,&colNum,&columnIsUsed]
+    auto getColumnType = [&] ()
+        {
+            return colNum < columnTypes.size()
+                ? columnTypes[colNum] : COLUMN_TYPE_AUTO;
+        };
+
+    auto finishString = [encoding,replaceInvalidCharactersWith,&colNum,&columnIsUsed,
+                         &errorMsg,&getColumnType]
         (const char * start, size_t len, bool eightBit) -> CellValue
         {
             // Short circuit for when we don't use the column
@@ -275,12 +390,24 @@ parseFixedWidthCsvRow(const char * & line,
                 return CellValue();
             }
 
+            ImportTextColumnType type = getColumnType();
+
+            if (type != COLUMN_TYPE_AUTO && type != COLUMN_TYPE_STRING) {
+                if (eightBit) {
+                    errorMsg = "non-ASCII character in typed column";
+                    return CellValue();
+                }
+                return parseTypedValue(start, len, type, errorMsg);
+            }
+
             if (!eightBit) {
                 char buf[len];
                 if (replaceInvalidCharactersWith >= 0) {
                     ExcAssert(replaceInvalidCharactersWith < 256);
                     start = findInvalidAscii(start, len, buf, (char)replaceInvalidCharactersWith);
                 }
+                if (type == COLUMN_TYPE_STRING)
+                    return CellValue(start, len, STRING_IS_VALID_ASCII);
                 return CellValue::parse(start, len, STRING_IS_VALID_ASCII);
             }
 
@@ -317,7 +444,7 @@ parseFixedWidthCsvRow(const char * & line,
             }
         };
 
-    while (colNum < numColumns) {
+    while (colNum < numColumns && !errorMsg) {
 
         ExcAssert(line <= lineEnd);
 
@@ -362,50 +489,55 @@ parseFixedWidthCsvRow(const char * & line,
             bool parseColumn = colNum >= columnIsUsed.size()
                 || columnIsUsed[colNum];
             
-            auto pushChar = [&] (char c)
+            // Append the characters from start up to end to the string
+            auto pushChars = [&] (const char * start, const char * end)
                 {
                     if (!parseColumn)
                         return;
                     
-                    if (len == buflen) {
-                        std::unique_ptr<char[]> newBuf(new char[buflen * 2]);
+                    size_t n = end - start;
+                    if (len + n > buflen) {
+                        while (len + n > buflen)
+                            buflen *= 2;
+                        std::unique_ptr<char[]> newBuf(new char[buflen]);
                         std::copy(s, s + len, newBuf.get());
                         sdynamic.swap(newBuf);
                         s = sdynamic.get();
-                        buflen *= 2;
                     }
 
-
-                    ExcAssertLess(len, buflen);
-                    eightBit = eightBit || !isascii(c);
-                    s[len++] = c;
+                    eightBit = eightBit || hasNonAscii(start, end);
+                    std::copy(start, end, s + len);
+                    len += n;
                 };
 
-            for (; line < lineEnd;  ++line) {
-                const char c = *line;
-                if (c == quote) {
+            // Jump from quote to quote, taking everything in between
+            while (line < lineEnd) {
+                const char * nextQuote
+                    = lineStart + index.nextQuote(line - lineStart);
+                pushChars(line, nextQuote);
+                line = nextQuote;
+                if (line == lineEnd)
+                    break;
+
+                ++line;
+                if (line >= lineEnd) {
+                    ok = true;
+                    break;
+                }
+                else if (*line == separator) {
+                    ok = true;
+                    ++line;
+                    break;
+                }
+                else if (*line == quote) {
+                    // doubled quote; take a literal value
+                    pushChars(line, line + 1);
                     ++line;
-                    if (line >= lineEnd) {
-                        ok = true;
-                        break;
-                    }
-                    else if (*line == separator) {
-                        ok = true;
-                        ++line;
-                        break;
-                    }
-                    else if (*line == quote) {
-                        // doubled quote; take a literal value
-                        pushChar(quote);
-                    }
-                    else {
-                        // Error
-                        errorMsg = "Garbage after closing quote";
-                        break;
-                    }
                 }
                 else {
-                    pushChar(c);
+                    // Error
+                    errorMsg = "Garbage after closing quote";
+                    break;
                 }
             }
 
@@ -417,40 +549,33 @@ parseFixedWidthCsvRow(const char * & line,
 
             values[colNum++] = finishString(s, len, eightBit);
         }
-        else if ((isdigit(c) || c == '-') && !isTextLine) {
+        else if ((isdigit(c) || c == '-') && !isTextLine
+                 && getColumnType() != COLUMN_TYPE_STRING
+                 && getColumnType() != COLUMN_TYPE_TIMESTAMP) {
             // Special case for something that looks like a number, in order to
             // save on parsing it.  We short circuit out when we get to a length
             // where we could start to lose digits, and fall back on parsing the
             // string version.
             int64_t sign = -(c == '-');
             uint64_t num = isdigit(c) ? c - '0' : 0;
-            int len = 1;
-            bool isInt = true;
 
-            bool eightBit = false;
+            const char * end = fieldEnd(line);
+            size_t len = end - start;
 
-            for (; line < lineEnd;  ++line, ++len) {
-                ExcAssert(line < lineEnd);
-                const char c = *line;
-                if (c == separator) {
-                    ++line;
-                    break;
-                }
-                if (line - start >= 18)
-                    isInt = false;  // too long; could lose precision
-                if (isInt && isdigit(c)) {
-                    num = 10 * num + (c - '0');
-                }
-                else if (!isascii(c)) {
-                    eightBit = true;
-                    isInt = false;
-                }
-                else {
-                    isInt = false;
-                }
+            // Longer than 18 characters could lose precision
+            bool isInt = len <= 18;
+            for (; isInt && line < end;  ++line) {
+                if (isdigit(*line))
+                    num = 10 * num + (*line - '0');
+                else isInt = false;
             }
 
-            if (isInt && sign == -1)
+            bool eightBit = !isInt && hasNonAscii(start, end);
+            line = end < lineEnd ? end + 1 : lineEnd;
+
+            if (isInt && getColumnType() == COLUMN_TYPE_NUMBER)
+                values[colNum++] = sign == -1 ? -(double)num : (double)num;
+            else if (isInt && sign == -1)
                 values[colNum++] = (int64_t)-num;
             else if (isInt)  // positive integer
                 values[colNum++] = num;
@@ -459,20 +584,12 @@ parseFixedWidthCsvRow(const char * & line,
                     = finishString(start, len, eightBit);
         }
         else {
-            // likely a non-quoted string
-
-            bool eightBit = !isascii(c);
-            size_t len = 1;
-
-            for (; line < lineEnd;  ++line, ++len) {
-                const char c = *line;
-                if (c == separator && !isTextLine) {
-                    ++line;
-                    break;
-                }
-                if (!isascii(c))
-                    eightBit = true;
-            }
+            // likely a non-quoted string, which goes up to the next
+            // separator
+            const char * end = fieldEnd(line);
+            size_t len = end - start;
+            bool eightBit = hasNonAscii(start, end);
+            line = end < lineEnd ? end + 1 : lineEnd;
 
             values[colNum++] = finishString(start, len, eightBit);
         }
@@ -501,6 +618,95 @@ parseFixedWidthCsvRow(const char * & line,
 
 static OptimizedPath moveIntoOutputs("mldb.textual.importText.moveIntoOutputs");
     
+/** Stream buffer that reads a source stream a given number of lines at a
+    time, and doesn't read past the end of the last of them.  This allows
+    an import to stop between two lines to save a checkpoint, and carry
+    on from where it stopped.
+*/
+struct LineSegmentStreambuf: public std::streambuf {
+    LineSegmentStreambuf(std::istream & source)
+        : source(source), buffer(BUFFER_SIZE), dataEnd(buffer.data())
+    {
+        setg(buffer.data(), buffer.data(), buffer.data());
+    }
+
+    /** Start the next segment, with at most the given number of lines.
+        What was read past the end of the last one is returned first. */
+    void startSegment(int64_t maxLines)
+    {
+        ExcAssertGreater(maxLines, 0);
+        linesLeft = maxLines;
+        linesRead = 0;
+        segmentDone = false;
+        setg(egptr(), egptr(), egptr());
+    }
+
+    /// Number of lines in the segment so far
+    int64_t segmentLines() const { return linesRead; }
+
+    /// Is there nothing more to read from the source?
+    bool exhausted() const { return sourceDone && egptr() == dataEnd; }
+
+    virtual int_type underflow() override
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+        if (segmentDone)
+            return traits_type::eof();
+
+        char * pos = egptr();
+        if (pos == dataEnd) {
+            if (!sourceDone) {
+                source.read(buffer.data(), buffer.size());
+                pos = buffer.data();
+                dataEnd = pos + source.gcount();
+                sourceDone = dataEnd == pos;
+            }
+            if (sourceDone) {
+                // The last line may not have had a newline
+                if (midLine)
+                    ++linesRead;
+                midLine = false;
+                segmentDone = true;
+                setg(pos, pos, pos);
+                return traits_type::eof();
+            }
+        }
+
+        // Give out up to the end of the segment's last line
+        char * end = pos;
+        while (end < dataEnd) {
+            char * nl = (char *)memchr(end, '\n', dataEnd - end);
+            if (!nl) {
+                end = dataEnd;
+                break;
+            }
+            end = nl + 1;
+            ++linesRead;
+            if (--linesLeft == 0) {
+                segmentDone = true;
+                break;
+            }
+        }
+
+        midLine = end[-1] != '\n';
+        setg(pos, pos, end);
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    std::istream & source;
+    std::vector<char> buffer;
+    char * dataEnd;            ///< End of what was read into the buffer
+    int64_t linesLeft = 0;
+    int64_t linesRead = 0;
+    bool segmentDone = true;
+    bool sourceDone = false;
+    bool midLine = false;      ///< Was the last line given out unfinished?
+};
+
 struct ImportTextProcedureWorkInstance
 {
     ImportTextProcedureWorkInstance(std::shared_ptr<spdlog::logger> logger)
@@ -528,6 +734,8 @@ struct ImportTextProcedureWorkInstance
     // output column names that will be created once parsing has
     // happened.
     vector<ColumnPath> inputColumnNames;
+    // Declared types of the input columns, or empty if none are declared
+    vector<ImportTextColumnType> inputColumnTypes;
     bool isTextLine;
     std::atomic<int> areOutputColumnNamesKnown;
     char separator;
@@ -550,6 +758,7 @@ struct ImportTextProcedureWorkInstance
     void loadText(const ImportTextConfig& config,
                   std::shared_ptr<Dataset> dataset,
                   MldbEngine * engine,
+                  ProcedureCheckpoint & checkpoint,
                   const std::function<bool (const Json::Value &)> & onProgress)
     {
         string filename = config.dataFileUrl.toDecodedString();
@@ -560,6 +769,26 @@ struct ImportTextProcedureWorkInstance
         // Get the file timestamp out
         ts = stream.info().lastModified;
 
+        // The rows of the checkpoint we resume from go back in first.  It
+        // must have been taken from the same file.
+        const Json::Value & resumed = checkpoint.resumed();
+        if (!resumed.isNull()) {
+            if (resumed["dataFileUrl"].asString() != config.dataFileUrl.toString()
+                || resumed["lastModified"].asString() != ts.printIso8601()) {
+                throw AnnotatedException
+                    (400, "Can't resume import.text from its checkpoint, as "
+                     "the file has changed since it was taken",
+                     "dataFileUrl", config.dataFileUrl,
+                     "lastModified", ts,
+                     "checkpoint", resumed);
+            }
+
+            std::vector<Url> parts;
+            for (auto & p: resumed["parts"])
+                parts.emplace_back(p.asString());
+            dataset->restoreCheckpoint(parts);
+        }
+
         std::string line;
         
         // Skip those up to the offset
@@ -711,6 +940,21 @@ struct ImportTextProcedureWorkInstance
                                           "columnName", c);
         }
 
+        if (!config.columnTypes.empty()) {
+            inputColumnTypes.resize(inputColumnNames.size(), COLUMN_TYPE_AUTO);
+            for (auto & t: config.columnTypes) {
+                ColumnPath c = config.structuredColumnNames
+                    ? ColumnPath::parse(t.first) : ColumnPath(t.first);
+                auto it = inputColumnIndex.find(ColumnHash(c));
+                if (it == inputColumnIndex.end())
+                    throw AnnotatedException(400, "Column in columnTypes isn't "
+                                             "a column of the CSV file",
+                                             "columnName", c,
+                                             "knownColumnNames", inputColumnNames);
+                inputColumnTypes[it->second] = t.second;
+            }
+        }
+
         // Now we know the columns, we can bind our SQL expressions for the
         // select, where, named and timestamp parts of the expression.
         SqlCsvScope scope(engine, inputColumnNames, ts,
@@ -787,7 +1031,13 @@ struct ImportTextProcedureWorkInstance
             getline(stream, line);
         }
 
-        loadTextData(dataset, stream, config, scope, onProgress);
+        // And those that were imported before the checkpoint
+        int64_t linesDone = resumed["linesDone"].asInt();
+        for (int64_t i = 0;  stream && i < linesDone;  ++i, ++lineOffset) {
+            stream.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+
+        loadTextData(dataset, stream, config, scope, checkpoint, onProgress);
     }
 
     /*    Load, filter and format all lines and process them  */
@@ -796,6 +1046,7 @@ struct ImportTextProcedureWorkInstance
                  std::istream& stream,
                  const ImportTextConfig& config,
                  SqlCsvScope& scope,
+                 ProcedureCheckpoint & checkpoint,
                  const std::function<bool (const Json::Value &)> & onProgress)
     {
         Progress progress;
@@ -965,7 +1216,9 @@ struct ImportTextProcedureWorkInstance
         // circuit the evaluation of that expression.
         bool isNamedLineNumber = config.named->surface == "lineNumber()";
 
-        std::atomic<uint64_t> numSkipped(0);
+        const Json::Value & resumed = checkpoint.resumed();
+
+        std::atomic<uint64_t> numSkipped(resumed["numLineErrors"].asUInt());
 
         Timer timer;
 
@@ -1007,6 +1260,9 @@ struct ImportTextProcedureWorkInstance
             
             /// Bytes done in this thread
             uint64_t bytesDone = 0;
+
+            /// Structural index of the line being parsed
+            CsvLineIndex lineIndex;
         };
 
         PerThreadAccumulator<ThreadAccum> accum;
@@ -1034,8 +1290,20 @@ struct ImportTextProcedureWorkInstance
 
         //cerr << "outputColumnNames = " << jsonEncode(knownColumnNames) << endl;
         
-        atomic<ssize_t> lineCount(0);
+        atomic<ssize_t> lineCount(resumed["rowCount"].asInt());
         atomic<ssize_t> byteCount(0);
+
+        // The workers only add to lineCount; the progress is sampled and
+        // published from the reporter's thread
+        ProgressReporter progressReporter
+            ([&] () { return lineCount.load(std::memory_order_relaxed); },
+             [&] (uint64_t linesDone)
+             {
+                 iterationStep->updateValue(linesDone);
+                 onProgress(jsonEncode(iterationStep));
+                 return true;
+             });
+
         auto onLine = [&] (const char * line,
                            size_t length,
                            int chunkNum,
@@ -1049,14 +1317,10 @@ struct ImportTextProcedureWorkInstance
             if (threadAccum.linesDone > 100 || threadAccum.bytesDone > 65536) {
                 byteCount += threadAccum.bytesDone;
                 uint64_t linesDone
-                    = lineCount.fetch_add(threadAccum.linesDone)
+                    = lineCount.fetch_add(threadAccum.linesDone,
+                                          std::memory_order_relaxed)
                     + threadAccum.linesDone;
 
-                if (linesDone % PROGRESS_RATE_LOW < PROGRESS_RATE_LOW) {
-                    iterationStep->value = linesDone;
-                    onProgress(jsonEncode(iterationStep));
-                }
-                
                 // Look for the wraparound of the modulus
                 if (linesDone % 100000 < threadAccum.linesDone) {
                     double wall = timer.elapsed_wall();
@@ -1101,7 +1365,9 @@ struct ImportTextProcedureWorkInstance
                                             hasQuoteChar, logger,
                                             config.ignoreExtraColumns,
                                             config.processExcelFormulas,
-                                            scope.columnsUsed);
+                                            scope.columnsUsed,
+                                            threadAccum.lineIndex,
+                                            inputColumnTypes);
 
                 if (errorMsg) {
                     if(config.allowMultiLines) {
@@ -1302,7 +1568,88 @@ struct ImportTextProcedureWorkInstance
         };
 
 
-        if(!config.allowMultiLines) {
+        if (!config.allowMultiLines && checkpoint.enabled()) {
+            // The file is imported in segments, each of which is finished
+            // before the next starts, so that the lines before a
+            // checkpoint are all in the dataset and those after it aren't.
+            // The segments are sized to end about when a checkpoint is
+            // due, so the import only stalls for one at each checkpoint.
+            LineSegmentStreambuf segments(stream);
+            std::istream segmentStream(&segments);
+
+            int64_t linesDone = resumed["linesDone"].asInt();
+            std::vector<std::string> parts;
+            for (auto & p: resumed["parts"])
+                parts.push_back(p.asString());
+
+            auto saveCheckpoint = [&] ()
+                {
+                    accum.forEach([&] (ThreadAccum * accum)
+                                  {
+                                      byteCount += accum->bytesDone;
+                                      lineCount += accum->linesDone;
+                                      accum->bytesDone = 0;
+                                      accum->linesDone = 0;
+                                  });
+
+                    Url part = checkpoint.fileUrl
+                        ("part-" + std::to_string(parts.size()) + ".mldbds");
+                    dataset->saveCheckpoint(part);
+                    parts.push_back(part.toString());
+
+                    Json::Value progress;
+                    progress["dataFileUrl"] = config.dataFileUrl.toString();
+                    progress["lastModified"] = ts.printIso8601();
+                    progress["linesDone"] = linesDone;
+                    progress["rowCount"] = (int64_t)lineCount;
+                    progress["numLineErrors"] = (uint64_t)numSkipped;
+                    progress["parts"] = Json::Value(Json::arrayValue);
+                    for (auto & p: parts)
+                        progress["parts"].append(p);
+                    checkpoint.save(progress);
+
+                    INFO_MSG(logger) << "saved checkpoint after " << linesDone
+                                     << " lines";
+                };
+
+            static constexpr int64_t MIN_SEGMENT_LINES = 10000;
+            double linesPerSecond = 1000000;  // until we know better
+
+            for (;;) {
+                int64_t segmentLines = std::max<int64_t>
+                    (MIN_SEGMENT_LINES,
+                     linesPerSecond * checkpoint.interval());
+                if (config.limit != -1) {
+                    if (linesDone >= config.limit)
+                        break;
+                    segmentLines = std::min(segmentLines,
+                                            config.limit - linesDone);
+                }
+
+                segments.startSegment(segmentLines);
+                segmentStream.clear();
+
+                Timer segmentTimer;
+                forEachLineBlock(segmentStream, onLine, -1 /* maxLines */,
+                                 numCpus() /* parallelism */,
+                                 startChunk, doneChunk);
+
+                int64_t numLines = segments.segmentLines();
+                lineOffset += numLines;
+                linesDone += numLines;
+                linesPerSecond = numLines
+                    / std::max(segmentTimer.elapsed_wall(), 0.001);
+
+                // The rest is committed with everything else at the end
+                if (segments.exhausted()
+                    || (config.limit != -1 && linesDone >= config.limit))
+                    break;
+
+                if (checkpoint.due())
+                    saveCheckpoint();
+            }
+        }
+        else if(!config.allowMultiLines) {
             forEachLineBlock(stream, onLine, config.limit,
                              numCpus() /* parallelism */,
                              startChunk, doneChunk);
@@ -1348,6 +1695,8 @@ struct ImportTextProcedureWorkInstance
                           byteCount += accum->bytesDone;
                           lineCount += accum->linesDone;
                       });
+
+        progressReporter.finish();
         
         double wall = timer.elapsed_wall();
         INFO_MSG(logger)
@@ -1396,20 +1745,33 @@ run(const ProcedureRunConfig & run,
 {
     auto runProcConf = applyRunConfOverProcConf(config, run);
 
+    ProcedureCheckpoint checkpoint(run);
+    if (checkpoint.enabled() && config.allowMultiLines) {
+        throw AnnotatedException(400, "import.text can't save checkpoints "
+                                 "when allowMultiLines is set");
+    }
+
     std::shared_ptr<Dataset> dataset
         = createDataset(engine, runProcConf.outputDataset, onProgress,
                         true /*overwrite*/);
 
     ImportTextProcedureWorkInstance instance(logger);
 
-    instance.loadText(config, dataset, engine, onProgress);
+    instance.loadText(config, dataset, engine, checkpoint, onProgress);
 
     Json::Value status;
     status["numLineErrors"] = instance.numLineErrors;
     status["rowCount"] = instance.rowCount;
+    if (checkpoint.enabled()) {
+        status["checkpointsSaved"] = checkpoint.numSaved();
+        status["resumedFromLine"]
+            = checkpoint.resumed()["linesDone"].asInt();
+    }
 
     dataset->commit();
 
+    checkpoint.finish();
+
     return Any(status);
 }
 
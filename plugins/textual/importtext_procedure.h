@@ -18,6 +18,20 @@
 
 namespace MLDB {
 
+/** Declared type of a column of a text file, which allows its values to
+    be parsed directly into that type rather than having it detected for
+    each one.
+*/
+enum ImportTextColumnType {
+    COLUMN_TYPE_AUTO,       ///< Detect numbers; anything else is a string
+    COLUMN_TYPE_INTEGER,    ///< 64 bit signed or unsigned integers
+    COLUMN_TYPE_NUMBER,     ///< Floating point numbers
+    COLUMN_TYPE_TIMESTAMP,  ///< ISO 8601 timestamps
+    COLUMN_TYPE_STRING      ///< Strings, even if they look like numbers
+};
+
+DECLARE_ENUM_DESCRIPTION(ImportTextColumnType);
+
 
 struct ImportTextConfig : public ProcedureConfig  {
     static constexpr const char * name = "import.text";
@@ -36,6 +50,7 @@ struct ImportTextConfig : public ProcedureConfig  {
     bool structuredColumnNames = false;
     bool allowMultiLines = false;
     bool autoGenerateHeaders = false;
+    std::map<Utf8String, ImportTextColumnType> columnTypes;
 
     /// What to select from the CSV
     SelectExpression select = SelectExpression::STAR; 
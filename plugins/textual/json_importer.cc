@@ -25,6 +25,7 @@
 #include "mldb/rest/cancellation_exception.h"
 #include "mldb/engine/dataset_scope.h"
 #include "mldb/utils/log.h"
+#include "json_line_parser.h"
 
 using namespace std;
 
@@ -127,9 +128,19 @@ struct JsonScope : SqlExpressionMldbScope {
 
     JsonScope(MldbEngine * engine) : SqlExpressionMldbScope(engine){}
 
+    /// Top level keys of the objects that the bound expressions read
+    std::unordered_set<std::string> keysUsed;
+
+    /// Do the bound expressions read the whole object?
+    bool allKeysUsed = false;
+
     ColumnGetter doGetColumn(const Utf8String & tableName,
                                 const ColumnPath & columnName) override
     {
+        if (columnName.empty())
+            allKeysUsed = true;
+        else keysUsed.insert(columnName.front().toUtf8String().rawString());
+
         return {[=] (const SqlRowScope & scope, ExpressionValue & storage,
                      const VariableFilter & filter) -> const ExpressionValue &
             {
@@ -150,6 +161,7 @@ struct JsonScope : SqlExpressionMldbScope {
                     const ColumnFilter& keep) override
     {
         std::vector<KnownColumn> columnsWithInfo;
+        allKeysUsed = true;
 
         auto exec = [=] (const SqlRowScope & scope, const VariableFilter & filter)
         {
@@ -250,7 +262,7 @@ struct JSONImporter: public Procedure {
         Date zeroTs;
 
         std::atomic<int64_t> errors(0);
-        std::atomic<int64_t> recordedLines(0);
+        ProgressCounter recordedLines;
         int64_t lineOffset = 1;
         std::string line;
         std::string filename = runProcConf.dataFileUrl.toDecodedString();
@@ -318,8 +330,22 @@ struct JSONImporter: public Procedure {
         const auto whereBound = config.where->bind(jsonScope);
         const auto selectBound = config.select.bind(jsonScope);
         const auto namedBound = config.named->bind(jsonScope);
-        bool keepGoing = true;
-        mutex progressMutex;
+
+        // Progress is published from the reporter's thread, so that the
+        // workers only need to count lines
+        ProgressReporter progressReporter
+            ([&] () { return recordedLines.total(); },
+             [&] (uint64_t numLines)
+             {
+                 iterationStep->updateValue(numLines);
+                 return onProgress(jsonEncode(progress));
+             });
+
+        // When the output is a selection, the keys of the objects that
+        // nothing reads are skipped rather than parsed
+        JsonLineParser lineParser(config.arrays,
+                                  useSelect && !jsonScope.allKeysUsed
+                                  ? &jsonScope.keysUsed : nullptr);
 
         auto onLine = [&] (const char * line,
                            size_t lineLength,
@@ -334,25 +360,30 @@ struct JSONImporter: public Procedure {
             if(lineLength == 0)
                 return handleError("empty line", actualLineNum, "");
 
-            StreamingJsonParsingContext parser(filename, line, lineLength,
-                                               actualLineNum);
+            ExpressionValue expr;
 
-            skipJsonWhitespace(*parser.context);
-            if (parser.context->eof()) {
-                return handleError("empty line", actualLineNum, "");
-            }
+            // Lines that the fast parser can't deal with go through the
+            // general one, which also gives the error messages
+            if (!lineParser.tryParse(line, lineLength, timestamp, expr)) {
+                StreamingJsonParsingContext parser(filename, line, lineLength,
+                                                   actualLineNum);
 
-            ExpressionValue expr;
-            try {
-                expr = ExpressionValue::parseJson(parser, timestamp,
-                                                  config.arrays);
-            } catch (const std::exception & exc) {
-                return handleError(exc.what(), actualLineNum, string(line, lineLength));
-            }
+                skipJsonWhitespace(*parser.context);
+                if (parser.context->eof()) {
+                    return handleError("empty line", actualLineNum, "");
+                }
+
+                try {
+                    expr = ExpressionValue::parseJson(parser, timestamp,
+                                                      config.arrays);
+                } catch (const std::exception & exc) {
+                    return handleError(exc.what(), actualLineNum, string(line, lineLength));
+                }
 
-            skipJsonWhitespace(*parser.context);
-            if (!parser.context->eof()) {
-                return handleError("extra characters at end of line", actualLineNum, "");
+                skipJsonWhitespace(*parser.context);
+                if (!parser.context->eof()) {
+                    return handleError("extra characters at end of line", actualLineNum, "");
+                }
             }
 
             RowPath rowName(actualLineNum);
@@ -377,24 +408,17 @@ struct JSONImporter: public Procedure {
 
             }
 
-            int numLines = recordedLines.fetch_add(1);
-            if (numLines % PROGRESS_RATE_LOW == 0) {
-                lock_guard<mutex> l(progressMutex);
-                if (numLines > iterationStep->value) {
-                    iterationStep->value = numLines;
-                }
-                keepGoing = onProgress(jsonEncode(progress));
-            }
+            recordedLines.add();
 
             threadAccum.threadRecorder->recordRowExprDestructive(
                 std::move(rowName), std::move(expr));
 
-            return keepGoing;
+            return !progressReporter.cancelled();
         };
 
         forEachLineBlock(stream, onLine, runProcConf.limit, 32,
                          startChunk, doneChunk);
-        if (!keepGoing) {
+        if (!progressReporter.finish()) {
             throw MLDB::CancellationException("Procedure import.json cancelled");
         }
 
@@ -410,7 +434,7 @@ struct JSONImporter: public Procedure {
         DEBUG_MSG(logger) << "done";
 
         Json::Value result;
-        result["rowCount"] = (int64_t)recordedLines;
+        result["rowCount"] = (int64_t)recordedLines.total();
         result["numLineErrors"] = (int64_t)errors;
         return RunOutput(result);
     }
@@ -0,0 +1,463 @@
+/** json_line_parser.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Fast parser for lines of JSON, straight into ExpressionValues.
+*/
+
+#include "json_line_parser.h"
+#include "mldb/types/json_printing.h"
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/// Thrown on anything that isn't valid JSON; never escapes tryParse()
+struct NotJson {
+};
+
+/** Return the first of the given characters in [p, end), or end if there
+    are none.  nonAscii is set if any of the bytes before it are non-ASCII.
+*/
+template<char... Chars>
+const char * findAny(const char * p, const char * end, bool & nonAscii)
+{
+#if defined(__SSE2__)
+    for (; p + 16 <= end;  p += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        __m128i matches = _mm_setzero_si128();
+        for (char c: { Chars... })
+            matches = _mm_or_si128(matches,
+                                   _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c)));
+        unsigned found = _mm_movemask_epi8(matches);
+        unsigned high = _mm_movemask_epi8(chunk);
+        if (found) {
+            unsigned before = (found & -found) - 1;
+            nonAscii = nonAscii || (high & before);
+            return p + __builtin_ctz(found);
+        }
+        nonAscii = nonAscii || high;
+    }
+#endif
+    for (; p < end;  ++p) {
+        for (char c: { Chars... }) {
+            if (*p == c)
+                return p;
+        }
+        nonAscii = nonAscii || (*p & 0x80);
+    }
+    return end;
+}
+
+bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+void appendUtf8(std::string & out, unsigned code)
+{
+    if (code < 0x80) {
+        out += char(code);
+    }
+    else if (code < 0x800) {
+        out += char(0xc0 | (code >> 6));
+        out += char(0x80 | (code & 0x3f));
+    }
+    else if (code < 0x10000) {
+        out += char(0xe0 | (code >> 12));
+        out += char(0x80 | ((code >> 6) & 0x3f));
+        out += char(0x80 | (code & 0x3f));
+    }
+    else {
+        out += char(0xf0 | (code >> 18));
+        out += char(0x80 | ((code >> 12) & 0x3f));
+        out += char(0x80 | ((code >> 6) & 0x3f));
+        out += char(0x80 | (code & 0x3f));
+    }
+}
+
+struct Parser {
+    const char * p;
+    const char * end;
+    Date timestamp;
+    JsonArrayHandling arrays;
+
+    void skipWhitespace()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            ++p;
+    }
+
+    void expect(char c)
+    {
+        skipWhitespace();
+        if (p == end || *p != c)
+            throw NotJson();
+        ++p;
+    }
+
+    bool match(char c)
+    {
+        skipWhitespace();
+        if (p < end && *p == c) {
+            ++p;
+            return true;
+        }
+        return false;
+    }
+
+    unsigned parseHex4()
+    {
+        if (end - p < 4)
+            throw NotJson();
+        unsigned result = 0;
+        for (int i = 0;  i < 4;  ++i) {
+            char c = *p++;
+            result <<= 4;
+            if (c >= '0' && c <= '9')
+                result |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                result |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                result |= c - 'A' + 10;
+            else throw NotJson();
+        }
+        return result;
+    }
+
+    /// Parse a string, which p points to the opening quote of
+    void parseString(std::string & out, bool & nonAscii)
+    {
+        ++p;
+        out.clear();
+        nonAscii = false;
+        for (;;) {
+            const char * q = findAny<'"', '\\'>(p, end, nonAscii);
+            if (q == end)
+                throw NotJson();
+            out.append(p, q);
+            p = q + 1;
+            if (*q == '"')
+                return;
+
+            // Escape sequence
+            if (p == end)
+                throw NotJson();
+            char c = *p++;
+            switch (c) {
+            case '"': case '\\': case '/': out += c;  break;
+            case 'b': out += '\b';  break;
+            case 'f': out += '\f';  break;
+            case 'n': out += '\n';  break;
+            case 'r': out += '\r';  break;
+            case 't': out += '\t';  break;
+            case 'u': {
+                unsigned code = parseHex4();
+                if (code >= 0xd800 && code < 0xdc00) {
+                    // High surrogate; must be followed by a low one
+                    if (end - p < 2 || p[0] != '\\' || p[1] != 'u')
+                        throw NotJson();
+                    p += 2;
+                    unsigned low = parseHex4();
+                    if (low < 0xdc00 || low >= 0xe000)
+                        throw NotJson();
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                }
+                else if (code >= 0xdc00 && code < 0xe000)
+                    throw NotJson();
+                if (code >= 0x80)
+                    nonAscii = true;
+                appendUtf8(out, code);
+                break;
+            }
+            default:
+                throw NotJson();
+            }
+        }
+    }
+
+    /// Skip a string, which p points to the opening quote of
+    void skipString()
+    {
+        bool nonAscii = false;
+        ++p;
+        for (;;) {
+            p = findAny<'"', '\\'>(p, end, nonAscii);
+            if (p == end)
+                throw NotJson();
+            if (*p++ == '"')
+                return;
+            if (p++ == end)
+                throw NotJson();
+        }
+    }
+
+    /// Skip over a value without parsing it.  Only the nesting of
+    /// brackets and strings is checked.
+    void skipValue()
+    {
+        skipWhitespace();
+        if (p == end)
+            throw NotJson();
+        if (*p == '"') {
+            skipString();
+            return;
+        }
+        if (*p == '{' || *p == '[') {
+            bool nonAscii = false;
+            std::string brackets;
+            while (p < end) {
+                p = findAny<'"', '{', '}', '[', ']'>(p, end, nonAscii);
+                if (p == end)
+                    break;
+                switch (*p) {
+                case '"':
+                    skipString();
+                    continue;
+                case '{':
+                case '[':
+                    brackets += *p;
+                    break;
+                default:
+                    if (brackets.back() != (*p == '}' ? '{' : '['))
+                        throw NotJson();
+                    brackets.pop_back();
+                }
+                ++p;
+                if (brackets.empty())
+                    return;
+            }
+            throw NotJson();
+        }
+        // An atom ends at the next separator
+        const char * start = p;
+        while (p < end && *p != ',' && *p != '}' && *p != ']'
+               && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+            ++p;
+        if (p == start)
+            throw NotJson();
+    }
+
+    bool matchLiteral(const char * literal, size_t length)
+    {
+        if (size_t(end - p) < length || strncmp(p, literal, length) != 0)
+            return false;
+        p += length;
+        return true;
+    }
+
+    CellValue parseNumber()
+    {
+        const char * start = p;
+        bool negative = *p == '-';
+        if (negative)
+            ++p;
+        if (p == end || !isDigit(*p))
+            throw NotJson();
+        // No leading zeros
+        if (*p == '0' && p + 1 < end && isDigit(p[1]))
+            throw NotJson();
+
+        uint64_t magnitude = 0;
+        bool overflow = false;
+        for (; p < end && isDigit(*p);  ++p) {
+            unsigned digit = *p - '0';
+            if (magnitude > (std::numeric_limits<uint64_t>::max() - digit) / 10)
+                overflow = true;
+            else magnitude = magnitude * 10 + digit;
+        }
+
+        bool isInteger = true;
+        if (p < end && *p == '.') {
+            isInteger = false;
+            ++p;
+            if (p == end || !isDigit(*p))
+                throw NotJson();
+            while (p < end && isDigit(*p))
+                ++p;
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            isInteger = false;
+            ++p;
+            if (p < end && (*p == '+' || *p == '-'))
+                ++p;
+            if (p == end || !isDigit(*p))
+                throw NotJson();
+            while (p < end && isDigit(*p))
+                ++p;
+        }
+
+        // Like the general parser, integers that fit in a long long are
+        // integers, and everything else is floating point
+        if (isInteger && !overflow) {
+            if (!negative && magnitude <= (uint64_t)std::numeric_limits<int64_t>::max())
+                return CellValue((long long)magnitude);
+            if (negative && magnitude <= (uint64_t)1 << 63)
+                return CellValue((long long)(0 - magnitude));
+        }
+
+        // The line isn't null terminated, so copy to convert
+        char buf[64];
+        size_t length = p - start;
+        if (length >= sizeof(buf)) {
+            std::string copy(start, p);
+            return CellValue(strtod(copy.c_str(), nullptr));
+        }
+        memcpy(buf, start, length);
+        buf[length] = 0;
+        return CellValue(strtod(buf, nullptr));
+    }
+
+    CellValue parseAtom()
+    {
+        skipWhitespace();
+        if (p == end)
+            throw NotJson();
+        switch (*p) {
+        case '"': {
+            std::string str;
+            bool nonAscii;
+            parseString(str, nonAscii);
+            return CellValue(str.data(), str.size(),
+                             nonAscii ? STRING_UNKNOWN : STRING_IS_VALID_ASCII);
+        }
+        case 't':
+            if (matchLiteral("true", 4))
+                return CellValue(1);
+            break;
+        case 'f':
+            if (matchLiteral("false", 5))
+                return CellValue(0);
+            break;
+        case 'n':
+            if (matchLiteral("null", 4))
+                return CellValue();
+            break;
+        default:
+            return parseNumber();
+        }
+        throw NotJson();
+    }
+
+    ExpressionValue parseValue(const std::unordered_set<std::string> * keys
+                               = nullptr)
+    {
+        skipWhitespace();
+        if (p == end)
+            throw NotJson();
+
+        if (*p == '{') {
+            ++p;
+            StructValue out;
+            out.reserve(16);
+            if (match('}'))
+                return ExpressionValue(std::move(out));
+
+            std::string key;
+            bool nonAscii;
+            do {
+                skipWhitespace();
+                if (p == end || *p != '"')
+                    throw NotJson();
+                parseString(key, nonAscii);
+                expect(':');
+                if (keys && !keys->count(key)) {
+                    skipValue();
+                    continue;
+                }
+                out.emplace_back(PathElement(key.data(), key.size()),
+                                 parseValue());
+            } while (match(','));
+            expect('}');
+            return ExpressionValue(std::move(out));
+        }
+        else if (*p == '[') {
+            ++p;
+            StructValue out;
+            out.reserve(16);
+            if (match(']'))
+                return ExpressionValue(std::move(out));
+
+            bool hasNonAtom = false;
+            bool hasNonObject = false;
+            do {
+                skipWhitespace();
+                if (p == end || *p != '{')
+                    hasNonObject = true;
+                out.emplace_back(PathElement(uint64_t(out.size())),
+                                 parseValue());
+                if (!std::get<1>(out.back()).isAtom())
+                    hasNonAtom = true;
+            } while (match(','));
+            expect(']');
+
+            // As in ExpressionValue::parseJson()
+            if (arrays == ENCODE_ARRAYS && !hasNonAtom) {
+                // One-hot encode them
+                for (auto & v: out) {
+                    PathElement & columnName = std::get<0>(v);
+                    ExpressionValue & columnValue = std::get<1>(v);
+
+                    columnName = PathElement(columnValue.toUtf8String());
+                    columnValue = ExpressionValue(1, timestamp);
+                }
+            }
+            else if (arrays == ENCODE_ARRAYS && !hasNonObject) {
+                // JSON encode them
+                for (auto & v: out) {
+                    ExpressionValue & columnValue = std::get<1>(v);
+                    Utf8String str;
+                    Utf8StringJsonPrintingContext context(str);
+                    columnValue.extractJson(context);
+                    columnValue = ExpressionValue(std::move(str), timestamp);
+                }
+            }
+
+            return ExpressionValue(std::move(out));
+        }
+
+        return ExpressionValue(parseAtom(), timestamp);
+    }
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* JSON LINE PARSER                                                          */
+/*****************************************************************************/
+
+JsonLineParser::
+JsonLineParser(JsonArrayHandling arrays,
+               const std::unordered_set<std::string> * keys)
+    : arrays(arrays), keys(keys)
+{
+}
+
+bool
+JsonLineParser::
+tryParse(const char * line, size_t length, Date timestamp,
+         ExpressionValue & result) const
+{
+    Parser parser{line, line + length, timestamp, arrays};
+    try {
+        result = parser.parseValue(keys);
+        parser.skipWhitespace();
+        return parser.p == parser.end;
+    } catch (...) {
+        // Not JSON, or an invalid UTF-8 string
+        return false;
+    }
+}
+
+} // namespace MLDB
@@ -0,0 +1,53 @@
+/** json_line_parser.h                                             -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Fast parser for lines of JSON, straight into ExpressionValues.
+*/
+
+#pragma once
+
+#include "mldb/sql/expression_value.h"
+#include <string>
+#include <unordered_set>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* JSON LINE PARSER                                                          */
+/*****************************************************************************/
+
+/** Parses a line holding a single JSON value into an ExpressionValue,
+    giving the same result as ExpressionValue::parseJson() but working
+    directly on the characters rather than through a JsonParsingContext.
+    Strings and skipped values are scanned 16 bytes at a time for the
+    characters that matter (quotes, backslashes and brackets).
+
+    The parser is strict: anything that isn't plain RFC 8259 JSON makes
+    tryParse() return false, so that the caller can fall back to the
+    general parser (which accepts a little more, and gives better error
+    messages).
+*/
+
+struct JsonLineParser {
+    /** Create a parser.  If keys is non-null, members of a top level
+        object whose key isn't in it are skipped over without being
+        parsed into values (or fully validated).
+    */
+    JsonLineParser(JsonArrayHandling arrays,
+                   const std::unordered_set<std::string> * keys = nullptr);
+
+    /** Parse the given line into the given value, which gets the given
+        timestamp.  Returns false if the line isn't a single valid JSON
+        value, optionally surrounded by whitespace.
+    */
+    bool tryParse(const char * line, size_t length, Date timestamp,
+                  ExpressionValue & result) const;
+
+private:
+    JsonArrayHandling arrays;
+    const std::unordered_set<std::string> * keys;
+};
+
+} // namespace MLDB
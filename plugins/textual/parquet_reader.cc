@@ -0,0 +1,1328 @@
+/** parquet_reader.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Reader for Apache Parquet files held in memory.
+*/
+
+#include "parquet_reader.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/types/date.h"
+#include "mldb/vfs/compressor.h"
+#include "mldb/ext/lz4/lz4.h"
+#include <cstring>
+#include <cmath>
+#include <memory>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+// Values of the enums in the Parquet Thrift definitions that we use
+enum Type {
+    TYPE_BOOLEAN = 0,
+    TYPE_INT32 = 1,
+    TYPE_INT64 = 2,
+    TYPE_INT96 = 3,
+    TYPE_FLOAT = 4,
+    TYPE_DOUBLE = 5,
+    TYPE_BYTE_ARRAY = 6,
+    TYPE_FIXED_LEN_BYTE_ARRAY = 7
+};
+
+enum ConvertedType {
+    CT_UTF8 = 0,
+    CT_ENUM = 4,
+    CT_DECIMAL = 5,
+    CT_DATE = 6,
+    CT_TIMESTAMP_MILLIS = 9,
+    CT_TIMESTAMP_MICROS = 10,
+    CT_UINT_8 = 11,
+    CT_UINT_16 = 12,
+    CT_UINT_32 = 13,
+    CT_UINT_64 = 14,
+    CT_JSON = 19
+};
+
+enum Repetition {
+    REQUIRED = 0,
+    OPTIONAL = 1,
+    REPEATED = 2
+};
+
+enum Codec {
+    UNCOMPRESSED = 0,
+    SNAPPY = 1,
+    GZIP = 2,
+    ZSTD = 6,
+    LZ4_RAW = 7
+};
+
+enum PageType {
+    DATA_PAGE = 0,
+    INDEX_PAGE = 1,
+    DICTIONARY_PAGE = 2,
+    DATA_PAGE_V2 = 3
+};
+
+enum Encoding {
+    PLAIN = 0,
+    PLAIN_DICTIONARY = 2,
+    RLE = 3,
+    DELTA_BINARY_PACKED = 5,
+    DELTA_LENGTH_BYTE_ARRAY = 6,
+    DELTA_BYTE_ARRAY = 7,
+    RLE_DICTIONARY = 8,
+    BYTE_STREAM_SPLIT = 9
+};
+
+// Number of days between the Julian day epoch and the Unix epoch, for
+// INT96 timestamps
+constexpr int64_t JULIAN_DAY_OF_EPOCH = 2440588;
+
+
+/*****************************************************************************/
+/* BYTE READER                                                               */
+/*****************************************************************************/
+
+/** Bounds-checked reader over a range of memory. */
+
+struct ByteReader {
+    ByteReader(const char * p = nullptr, size_t len = 0)
+        : p(p), end(p + len)
+    {
+    }
+
+    const char * p;
+    const char * end;
+
+    size_t remaining() const { return end - p; }
+
+    void need(size_t n) const
+    {
+        if (remaining() < n)
+            throw Exception("Parquet data is truncated or corrupt");
+    }
+
+    const char * skip(size_t n)
+    {
+        need(n);
+        const char * result = p;
+        p += n;
+        return result;
+    }
+
+    uint8_t readByte()
+    {
+        need(1);
+        return *p++;
+    }
+
+    template<typename T>
+    T readLittleEndian()
+    {
+        T result;
+        memcpy(&result, skip(sizeof(T)), sizeof(T));
+        return result;
+    }
+
+    uint64_t readVarint()
+    {
+        uint64_t result = 0;
+        for (int shift = 0;  shift < 64;  shift += 7) {
+            uint8_t b = readByte();
+            result |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return result;
+        }
+        throw Exception("Parquet varint is too long");
+    }
+
+    int64_t readZigzag()
+    {
+        uint64_t v = readVarint();
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    }
+};
+
+
+/*****************************************************************************/
+/* THRIFT COMPACT READER                                                     */
+/*****************************************************************************/
+
+/** Reads the Thrift compact protocol that the Parquet footer and page
+    headers are written in.  Fields that we don't know are skipped.
+*/
+
+struct ThriftCompactReader: public ByteReader {
+
+    enum FieldType {
+        T_STOP = 0,
+        T_BOOL_TRUE = 1,
+        T_BOOL_FALSE = 2,
+        T_BYTE = 3,
+        T_I16 = 4,
+        T_I32 = 5,
+        T_I64 = 6,
+        T_DOUBLE = 7,
+        T_BINARY = 8,
+        T_LIST = 9,
+        T_SET = 10,
+        T_MAP = 11,
+        T_STRUCT = 12
+    };
+
+    using ByteReader::ByteReader;
+
+    int depth = 0;
+
+    /** Read a struct, calling onField(id, type) for each field.  It returns
+        false if it didn't read the field, in which case it's skipped.
+    */
+    template<typename OnField>
+    void readStruct(OnField && onField)
+    {
+        if (++depth > 64)
+            throw Exception("Parquet metadata is nested too deeply");
+        int16_t lastId = 0;
+        for (;;) {
+            uint8_t header = readByte();
+            int type = header & 0x0f;
+            if (type == T_STOP)
+                break;
+            int delta = header >> 4;
+            int16_t id = delta ? lastId + delta : (int16_t)readZigzag();
+            lastId = id;
+            if (!onField(id, type))
+                skipValue(type);
+        }
+        --depth;
+    }
+
+    /** Read a list, calling onElement(type) for each element. */
+    template<typename OnElement>
+    void readList(OnElement && onElement)
+    {
+        uint8_t header = readByte();
+        size_t size = header >> 4;
+        int type = header & 0x0f;
+        if (size == 15)
+            size = readVarint();
+        for (size_t i = 0;  i < size;  ++i)
+            onElement(type);
+    }
+
+    int64_t readInt()
+    {
+        return readZigzag();
+    }
+
+    bool readBool(int type)
+    {
+        // Booleans in fields are in the type; in lists they're a byte
+        if (type == T_BOOL_TRUE)
+            return true;
+        if (type == T_BOOL_FALSE)
+            return false;
+        return readByte() == 1;
+    }
+
+    std::string readBinary()
+    {
+        size_t len = readVarint();
+        return std::string(skip(len), len);
+    }
+
+    void skipValue(int type)
+    {
+        switch (type) {
+        case T_BOOL_TRUE:
+        case T_BOOL_FALSE:
+            return;
+        case T_BYTE:
+            skip(1);
+            return;
+        case T_I16:
+        case T_I32:
+        case T_I64:
+            readVarint();
+            return;
+        case T_DOUBLE:
+            skip(8);
+            return;
+        case T_BINARY:
+            skip(readVarint());
+            return;
+        case T_LIST:
+        case T_SET:
+            readList([&] (int elementType)
+                     {
+                         if (elementType == T_BOOL_TRUE
+                             || elementType == T_BOOL_FALSE)
+                             skip(1);
+                         else skipValue(elementType);
+                     });
+            return;
+        case T_MAP: {
+            size_t size = readVarint();
+            if (size == 0)
+                return;
+            uint8_t types = readByte();
+            for (size_t i = 0;  i < size;  ++i) {
+                skipValue(types >> 4);
+                skipValue(types & 0x0f);
+            }
+            return;
+        }
+        case T_STRUCT:
+            readStruct([] (int16_t, int) { return false; });
+            return;
+        default:
+            throw Exception("Unknown Thrift type %d in Parquet metadata",
+                            type);
+        }
+    }
+};
+
+
+/*****************************************************************************/
+/* METADATA                                                                  */
+/*****************************************************************************/
+
+struct SchemaElement {
+    int type = -1;
+    int typeLength = 0;
+    int repetition = REQUIRED;
+    std::string name;
+    int numChildren = 0;
+    int convertedType = -1;
+    int scale = 0;
+
+    // From the logical type, which takes precedence over the converted type
+    int logicalType = -1;
+    bool logicalIsSigned = true;
+    double logicalTimeUnit = 0;
+};
+
+void readStatistics(ThriftCompactReader & reader, ParquetColumnChunk & chunk,
+                    bool deprecatedMinMaxAreValid)
+{
+    std::string minValue, maxValue, oldMin, oldMax;
+    bool hasMin = false, hasMax = false, hasOldMin = false, hasOldMax = false;
+
+    reader.readStruct([&] (int16_t id, int type)
+        {
+            switch (id) {
+            case 1: oldMax = reader.readBinary();  hasOldMax = true;  return true;
+            case 2: oldMin = reader.readBinary();  hasOldMin = true;  return true;
+            case 3:
+                chunk.nullCount = reader.readInt();
+                chunk.hasNullCount = true;
+                return true;
+            case 5: maxValue = reader.readBinary();  hasMax = true;  return true;
+            case 6: minValue = reader.readBinary();  hasMin = true;  return true;
+            default: return false;
+            }
+        });
+
+    if (hasMin && hasMax) {
+        chunk.hasMinMax = true;
+        chunk.minValue = std::move(minValue);
+        chunk.maxValue = std::move(maxValue);
+    }
+    else if (hasOldMin && hasOldMax && deprecatedMinMaxAreValid) {
+        chunk.hasMinMax = true;
+        chunk.minValue = std::move(oldMin);
+        chunk.maxValue = std::move(oldMax);
+    }
+}
+
+ParquetColumnChunk
+readColumnChunk(ThriftCompactReader & reader, const ParquetColumn & column)
+{
+    // The deprecated min and max were compared as signed values, which
+    // is only right for signed numbers
+    bool deprecatedMinMaxAreValid
+        = column.physicalType != TYPE_BYTE_ARRAY
+        && column.physicalType != TYPE_FIXED_LEN_BYTE_ARRAY
+        && column.physicalType != TYPE_INT96
+        && column.kind != ParquetColumn::UNSIGNED;
+
+    ParquetColumnChunk result;
+    bool hasMetadata = false;
+
+    reader.readStruct([&] (int16_t id, int type)
+        {
+            if (id == 1) {
+                throw Exception("Parquet column chunks in external files "
+                                "are not supported");
+            }
+            if (id != 3)
+                return false;
+
+            hasMetadata = true;
+            reader.readStruct([&] (int16_t id, int type)
+                {
+                    switch (id) {
+                    case 4: result.codec = reader.readInt();  return true;
+                    case 5: result.numValues = reader.readInt();  return true;
+                    case 7:
+                        result.totalCompressedSize = reader.readInt();
+                        return true;
+                    case 9: result.dataPageOffset = reader.readInt();  return true;
+                    case 11:
+                        result.dictionaryPageOffset = reader.readInt();
+                        return true;
+                    case 12:
+                        readStatistics(reader, result,
+                                       deprecatedMinMaxAreValid);
+                        return true;
+                    default:
+                        return false;
+                    }
+                });
+            return true;
+        });
+
+    if (!hasMetadata)
+        throw Exception("Parquet column chunk has no metadata");
+
+    return result;
+}
+
+/** Work out how the values of a leaf column with the given schema element
+    are turned into CellValues.
+*/
+void setColumnKind(ParquetColumn & column, const SchemaElement & element,
+                   bool binaryAsString)
+{
+    auto setTimestamp = [&] (double unit)
+        {
+            column.kind = ParquetColumn::TIMESTAMP;
+            column.timeUnit = unit;
+        };
+
+    // Logical types are in the LogicalType union order
+    switch (element.logicalType) {
+    case 1:   // STRING
+    case 4:   // ENUM
+    case 12:  // JSON
+        column.kind = ParquetColumn::STRING;
+        return;
+    case 5:   // DECIMAL
+        column.kind = ParquetColumn::DECIMAL;
+        return;
+    case 6:   // DATE
+        column.kind = ParquetColumn::DATE;
+        return;
+    case 8:   // TIMESTAMP
+        setTimestamp(element.logicalTimeUnit);
+        return;
+    case 10:  // INTEGER
+        column.kind = element.logicalIsSigned
+            ? ParquetColumn::INTEGER : ParquetColumn::UNSIGNED;
+        return;
+    default:
+        break;
+    }
+
+    switch (element.convertedType) {
+    case CT_UTF8:
+    case CT_ENUM:
+    case CT_JSON:
+        column.kind = ParquetColumn::STRING;
+        return;
+    case CT_DECIMAL:
+        column.kind = ParquetColumn::DECIMAL;
+        return;
+    case CT_DATE:
+        column.kind = ParquetColumn::DATE;
+        return;
+    case CT_TIMESTAMP_MILLIS:
+        setTimestamp(0.001);
+        return;
+    case CT_TIMESTAMP_MICROS:
+        setTimestamp(0.000001);
+        return;
+    case CT_UINT_8:
+    case CT_UINT_16:
+    case CT_UINT_32:
+    case CT_UINT_64:
+        column.kind = ParquetColumn::UNSIGNED;
+        return;
+    default:
+        break;
+    }
+
+    switch (element.type) {
+    case TYPE_BOOLEAN:
+        column.kind = ParquetColumn::BOOLEAN;
+        return;
+    case TYPE_INT32:
+    case TYPE_INT64:
+        column.kind = ParquetColumn::INTEGER;
+        return;
+    case TYPE_INT96:
+        setTimestamp(0);
+        return;
+    case TYPE_FLOAT:
+    case TYPE_DOUBLE:
+        column.kind = ParquetColumn::FLOAT;
+        return;
+    case TYPE_BYTE_ARRAY:
+        column.kind = binaryAsString
+            ? ParquetColumn::STRING : ParquetColumn::BLOB;
+        return;
+    default:
+        column.kind = ParquetColumn::BLOB;
+        return;
+    }
+}
+
+
+/*****************************************************************************/
+/* DECOMPRESSION                                                             */
+/*****************************************************************************/
+
+/** Decompress a raw Snappy block, which has no framing. */
+std::string snappyDecompress(const char * data, size_t len)
+{
+    ByteReader reader(data, len);
+    size_t outputLength = reader.readVarint();
+
+    std::string result;
+    result.reserve(outputLength);
+
+    while (reader.remaining()) {
+        uint8_t tag = reader.readByte();
+        size_t length, offset;
+
+        switch (tag & 3) {
+        case 0: {
+            // Literal, with the length in the tag or the bytes after it
+            length = tag >> 2;
+            if (length >= 60) {
+                size_t numBytes = length - 59;
+                length = 0;
+                for (size_t i = 0;  i < numBytes;  ++i)
+                    length |= size_t(reader.readByte()) << (8 * i);
+            }
+            length += 1;
+            result.append(reader.skip(length), length);
+            continue;
+        }
+        case 1:
+            length = 4 + ((tag >> 2) & 7);
+            offset = (size_t(tag >> 5) << 8) | reader.readByte();
+            break;
+        case 2:
+            length = (tag >> 2) + 1;
+            offset = reader.readLittleEndian<uint16_t>();
+            break;
+        default:
+            length = (tag >> 2) + 1;
+            offset = reader.readLittleEndian<uint32_t>();
+            break;
+        }
+
+        if (offset == 0 || offset > result.size())
+            throw Exception("Snappy data in Parquet file is corrupt");
+
+        // Copies may overlap with what they write, so go a byte at a time
+        size_t start = result.size() - offset;
+        for (size_t i = 0;  i < length;  ++i)
+            result.push_back(result[start + i]);
+    }
+
+    if (result.size() != outputLength)
+        throw Exception("Snappy data in Parquet file has the wrong length");
+
+    return result;
+}
+
+/** Decompress a page with the given codec into uncompressedLength bytes. */
+std::string decompressPage(int codec, const char * data, size_t len,
+                           size_t uncompressedLength)
+{
+    std::string result;
+
+    auto decompressStream = [&] (const char * compression)
+        {
+            std::unique_ptr<Decompressor> decompressor
+                (Decompressor::create(compression));
+            result.reserve(uncompressedLength);
+            auto onData = [&] (const char * data, size_t len)
+                {
+                    result.append(data, len);
+                    return len;
+                };
+            decompressor->decompress(data, len, onData);
+            decompressor->finish(onData);
+        };
+
+    switch (codec) {
+    case UNCOMPRESSED:
+        result.assign(data, len);
+        break;
+    case SNAPPY:
+        result = snappyDecompress(data, len);
+        break;
+    case GZIP:
+        decompressStream("gzip");
+        break;
+    case ZSTD:
+        decompressStream("zstd");
+        break;
+    case LZ4_RAW: {
+        result.resize(uncompressedLength);
+        int res = LZ4_decompress_safe(data, &result[0], len,
+                                      uncompressedLength);
+        if (res < 0)
+            throw Exception("LZ4 data in Parquet file is corrupt");
+        result.resize(res);
+        break;
+    }
+    default:
+        throw Exception("Parquet compression codec %d is not supported",
+                        codec);
+    }
+
+    if (result.size() != uncompressedLength)
+        throw Exception("Parquet page has the wrong length after "
+                        "decompression");
+    return result;
+}
+
+
+/*****************************************************************************/
+/* ENCODINGS                                                                 */
+/*****************************************************************************/
+
+/** Read a value of the given number of bits from a little endian,
+    LSB first, bit-packed array.
+*/
+uint64_t readBitPacked(const unsigned char * data, size_t bitOffset,
+                       int bitWidth)
+{
+    uint64_t result = 0;
+    for (int i = 0;  i < bitWidth;) {
+        size_t bit = bitOffset + i;
+        int inByte = std::min(8 - int(bit % 8), bitWidth - i);
+        uint64_t bits = (data[bit / 8] >> (bit % 8)) & ((1U << inByte) - 1);
+        result |= bits << i;
+        i += inByte;
+    }
+    return result;
+}
+
+/** Decode numValues values from the RLE / bit-packed hybrid encoding,
+    which is used for levels, dictionary indexes and booleans.
+*/
+void decodeRleHybrid(ByteReader & reader, int bitWidth, size_t numValues,
+                     std::vector<uint32_t> & output)
+{
+    if (bitWidth < 0 || bitWidth > 32)
+        throw Exception("Parquet RLE bit width %d is invalid", bitWidth);
+
+    output.clear();
+    output.reserve(numValues);
+
+    while (output.size() < numValues) {
+        uint64_t header = reader.readVarint();
+        if (header & 1) {
+            // Bit-packed run of groups of 8 values, each group taking
+            // bitWidth bytes
+            size_t count = (header >> 1) * 8;
+            size_t numBytes = (header >> 1) * bitWidth;
+            if (numBytes > reader.remaining()) {
+                // Tolerate a last group that's cut short
+                numBytes = reader.remaining();
+                count = numBytes * 8 / bitWidth;
+            }
+            auto data = (const unsigned char *)reader.skip(numBytes);
+            for (size_t i = 0;  i < count && output.size() < numValues;  ++i)
+                output.push_back(readBitPacked(data, i * bitWidth, bitWidth));
+            if (count == 0)
+                throw Exception("Parquet bit-packed run is empty");
+        }
+        else {
+            size_t count = header >> 1;
+            uint32_t value = 0;
+            for (int i = 0;  i < (bitWidth + 7) / 8;  ++i)
+                value |= uint32_t(reader.readByte()) << (8 * i);
+            if (count == 0)
+                throw Exception("Parquet RLE run is empty");
+            count = std::min(count, numValues - output.size());
+            output.insert(output.end(), count, value);
+        }
+    }
+}
+
+/** Decode the DELTA_BINARY_PACKED encoding. */
+void decodeDeltaBinaryPacked(ByteReader & reader,
+                             std::vector<int64_t> & output)
+{
+    size_t blockSize = reader.readVarint();
+    size_t numMiniBlocks = reader.readVarint();
+    size_t numValues = reader.readVarint();
+    int64_t value = reader.readZigzag();
+
+    if (numMiniBlocks == 0 || blockSize % numMiniBlocks != 0
+        || blockSize / numMiniBlocks % 8 != 0)
+        throw Exception("Parquet delta encoding header is invalid");
+    size_t valuesPerMiniBlock = blockSize / numMiniBlocks;
+
+    output.clear();
+    if (numValues > 0)
+        output.push_back(value);
+
+    std::vector<uint8_t> bitWidths(numMiniBlocks);
+    while (output.size() < numValues) {
+        int64_t minDelta = reader.readZigzag();
+        for (auto & w: bitWidths) {
+            w = reader.readByte();
+            if (w > 64)
+                throw Exception("Parquet delta bit width is invalid");
+        }
+
+        for (size_t i = 0;  i < numMiniBlocks && output.size() < numValues;
+             ++i) {
+            int bitWidth = bitWidths[i];
+            size_t numBytes = valuesPerMiniBlock * bitWidth / 8;
+            auto data = (const unsigned char *)reader.skip(numBytes);
+            for (size_t j = 0;
+                 j < valuesPerMiniBlock && output.size() < numValues;  ++j) {
+                uint64_t delta = readBitPacked(data, j * bitWidth, bitWidth);
+                // Wraparound is the defined behaviour
+                value = (int64_t)((uint64_t)value + (uint64_t)minDelta
+                                  + delta);
+                output.push_back(value);
+            }
+        }
+    }
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COLUMN DECODER                                                            */
+/*****************************************************************************/
+
+/** Turns the physical values of a column into CellValues. */
+
+struct ParquetValueDecoder {
+    ParquetValueDecoder(const ParquetColumn & column)
+        : column(column)
+    {
+    }
+
+    const ParquetColumn & column;
+
+    CellValue fromInteger(int64_t value) const
+    {
+        switch (column.kind) {
+        case ParquetColumn::UNSIGNED:
+            // Unsigned values are stored in signed physical types
+            if (column.physicalType == TYPE_INT32)
+                return (uint32_t)value;
+            return (uint64_t)value;
+        case ParquetColumn::DECIMAL:
+            return value * std::pow(10.0, -column.scale);
+        case ParquetColumn::DATE:
+            return Date::fromSecondsSinceEpoch(value * 86400.0);
+        case ParquetColumn::TIMESTAMP:
+            return Date::fromSecondsSinceEpoch(value * column.timeUnit);
+        case ParquetColumn::BOOLEAN:
+        case ParquetColumn::INTEGER:
+        default:
+            return value;
+        }
+    }
+
+    CellValue fromBytes(const char * p, size_t len) const
+    {
+        switch (column.kind) {
+        case ParquetColumn::STRING:
+            return CellValue(p, len, STRING_UNKNOWN);
+        case ParquetColumn::DECIMAL: {
+            // Big endian two's complement
+            if (len == 0)
+                return 0.0;
+            double result = (signed char)p[0];
+            for (size_t i = 1;  i < len;  ++i)
+                result = result * 256 + (unsigned char)p[i];
+            return result * std::pow(10.0, -column.scale);
+        }
+        default:
+            return CellValue::blob(p, len);
+        }
+    }
+
+    /** Decode a single PLAIN value.  Booleans are handled separately as
+        they are bit-packed.
+    */
+    CellValue readPlain(ByteReader & reader) const
+    {
+        switch (column.physicalType) {
+        case TYPE_INT32:
+            return fromInteger(reader.readLittleEndian<int32_t>());
+        case TYPE_INT64:
+            return fromInteger(reader.readLittleEndian<int64_t>());
+        case TYPE_INT96: {
+            int64_t nanos = reader.readLittleEndian<int64_t>();
+            int64_t julianDay = reader.readLittleEndian<int32_t>();
+            return Date::fromSecondsSinceEpoch
+                ((julianDay - JULIAN_DAY_OF_EPOCH) * 86400.0 + nanos * 1e-9);
+        }
+        case TYPE_FLOAT:
+            return reader.readLittleEndian<float>();
+        case TYPE_DOUBLE:
+            return reader.readLittleEndian<double>();
+        case TYPE_BYTE_ARRAY: {
+            uint32_t len = reader.readLittleEndian<uint32_t>();
+            return fromBytes(reader.skip(len), len);
+        }
+        case TYPE_FIXED_LEN_BYTE_ARRAY:
+            return fromBytes(reader.skip(column.typeLength),
+                             column.typeLength);
+        default:
+            throw Exception("Parquet physical type %d can't be read",
+                            column.physicalType);
+        }
+    }
+
+    /** Decode numValues values in the given encoding into output. */
+    void decode(int encoding, ByteReader & reader, size_t numValues,
+                const std::vector<CellValue> * dictionary,
+                std::vector<CellValue> & output) const
+    {
+        output.clear();
+        output.reserve(numValues);
+
+        switch (encoding) {
+        case PLAIN:
+            if (column.physicalType == TYPE_BOOLEAN) {
+                auto data = (const unsigned char *)
+                    reader.skip((numValues + 7) / 8);
+                for (size_t i = 0;  i < numValues;  ++i)
+                    output.emplace_back((data[i / 8] >> (i % 8)) & 1);
+            }
+            else {
+                for (size_t i = 0;  i < numValues;  ++i)
+                    output.emplace_back(readPlain(reader));
+            }
+            return;
+
+        case PLAIN_DICTIONARY:
+        case RLE_DICTIONARY: {
+            if (!dictionary)
+                throw Exception("Parquet dictionary encoded page has no "
+                                "dictionary");
+            int bitWidth = reader.readByte();
+            std::vector<uint32_t> indexes;
+            decodeRleHybrid(reader, bitWidth, numValues, indexes);
+            for (auto i: indexes) {
+                if (i >= dictionary->size())
+                    throw Exception("Parquet dictionary index out of range");
+                output.emplace_back((*dictionary)[i]);
+            }
+            return;
+        }
+
+        case RLE: {
+            if (column.physicalType != TYPE_BOOLEAN)
+                throw Exception("Parquet RLE encoding is only supported "
+                                "for booleans");
+            uint32_t len = reader.readLittleEndian<uint32_t>();
+            ByteReader values(reader.skip(len), len);
+            std::vector<uint32_t> bits;
+            decodeRleHybrid(values, 1, numValues, bits);
+            for (auto b: bits)
+                output.emplace_back(b);
+            return;
+        }
+
+        case DELTA_BINARY_PACKED: {
+            if (column.physicalType != TYPE_INT32
+                && column.physicalType != TYPE_INT64)
+                throw Exception("Parquet delta encoding is only supported "
+                                "for integers");
+            std::vector<int64_t> values;
+            decodeDeltaBinaryPacked(reader, values);
+            if (values.size() < numValues)
+                throw Exception("Parquet page has too few values");
+            for (size_t i = 0;  i < numValues;  ++i) {
+                // INT32 values wrap around at 32 bits
+                output.emplace_back
+                    (fromInteger(column.physicalType == TYPE_INT32
+                                 ? (int32_t)values[i] : values[i]));
+            }
+            return;
+        }
+
+        case DELTA_LENGTH_BYTE_ARRAY:
+        case DELTA_BYTE_ARRAY: {
+            if (column.physicalType != TYPE_BYTE_ARRAY)
+                throw Exception("Parquet delta byte array encoding is only "
+                                "supported for byte arrays");
+            std::vector<int64_t> prefixLengths, lengths;
+            if (encoding == DELTA_BYTE_ARRAY)
+                decodeDeltaBinaryPacked(reader, prefixLengths);
+            decodeDeltaBinaryPacked(reader, lengths);
+            if (lengths.size() < numValues
+                || (encoding == DELTA_BYTE_ARRAY
+                    && prefixLengths.size() < numValues))
+                throw Exception("Parquet page has too few values");
+
+            std::string value;
+            for (size_t i = 0;  i < numValues;  ++i) {
+                if (lengths[i] < 0)
+                    throw Exception("Parquet byte array length is invalid");
+                const char * suffix = reader.skip(lengths[i]);
+                if (encoding == DELTA_BYTE_ARRAY) {
+                    if (prefixLengths[i] < 0
+                        || prefixLengths[i] > value.size())
+                        throw Exception("Parquet prefix length is invalid");
+                    value.resize(prefixLengths[i]);
+                    value.append(suffix, lengths[i]);
+                    output.emplace_back(fromBytes(value.data(), value.size()));
+                }
+                else {
+                    output.emplace_back(fromBytes(suffix, lengths[i]));
+                }
+            }
+            return;
+        }
+
+        case BYTE_STREAM_SPLIT: {
+            size_t width;
+            switch (column.physicalType) {
+            case TYPE_FLOAT:
+            case TYPE_INT32: width = 4;  break;
+            case TYPE_DOUBLE:
+            case TYPE_INT64: width = 8;  break;
+            case TYPE_FIXED_LEN_BYTE_ARRAY: width = column.typeLength;  break;
+            default:
+                throw Exception("Parquet byte stream split encoding is not "
+                                "supported for physical type %d",
+                                column.physicalType);
+            }
+
+            // Byte k of value i is at k * numValues + i
+            const char * data = reader.skip(width * numValues);
+            std::string value(width, '\0');
+            for (size_t i = 0;  i < numValues;  ++i) {
+                for (size_t k = 0;  k < width;  ++k)
+                    value[k] = data[k * numValues + i];
+                ByteReader valueReader(value.data(), width);
+                output.emplace_back(readPlain(valueReader));
+            }
+            return;
+        }
+
+        default:
+            throw Exception("Parquet encoding %d is not supported", encoding);
+        }
+    }
+};
+
+
+/*****************************************************************************/
+/* PARQUET FILE                                                              */
+/*****************************************************************************/
+
+ParquetFile::
+ParquetFile(const char * data, size_t length, bool binaryAsString)
+    : data(data), length(length)
+{
+    static const char MAGIC[4] = { 'P', 'A', 'R', '1' };
+    if (length < 12 || memcmp(data, MAGIC, 4) != 0
+        || memcmp(data + length - 4, MAGIC, 4) != 0)
+        throw Exception("File is not in Parquet format");
+
+    uint32_t footerLength;
+    memcpy(&footerLength, data + length - 8, 4);
+    if (footerLength > length - 12)
+        throw Exception("Parquet footer length is invalid");
+
+    ThriftCompactReader reader(data + length - 8 - footerLength,
+                               footerLength);
+
+    std::vector<SchemaElement> schema;
+
+    auto readSchemaElement = [&] (int type)
+        {
+            SchemaElement element;
+            reader.readStruct([&] (int16_t id, int type)
+                {
+                    switch (id) {
+                    case 1: element.type = reader.readInt();  return true;
+                    case 2: element.typeLength = reader.readInt();  return true;
+                    case 3: element.repetition = reader.readInt();  return true;
+                    case 4: element.name = reader.readBinary();  return true;
+                    case 5: element.numChildren = reader.readInt();  return true;
+                    case 6: element.convertedType = reader.readInt();  return true;
+                    case 7: element.scale = reader.readInt();  return true;
+                    case 10:
+                        // LogicalType union; we only need the kind and
+                        // the parameters of some of them
+                        reader.readStruct([&] (int16_t kind, int type)
+                            {
+                                element.logicalType = kind;
+                                reader.readStruct([&] (int16_t id, int type)
+                                    {
+                                        if (kind == 5 && id == 1) {
+                                            element.scale = reader.readInt();
+                                            return true;
+                                        }
+                                        if (kind == 8 && id == 2) {
+                                            // TimeUnit union
+                                            reader.readStruct
+                                                ([&] (int16_t unit, int)
+                                                 {
+                                                     element.logicalTimeUnit
+                                                         = unit == 1 ? 1e-3
+                                                         : unit == 2 ? 1e-6
+                                                         : 1e-9;
+                                                     return false;
+                                                 });
+                                            return true;
+                                        }
+                                        if (kind == 10 && id == 2) {
+                                            element.logicalIsSigned
+                                                = reader.readBool(type);
+                                            return true;
+                                        }
+                                        return false;
+                                    });
+                                return true;
+                            });
+                        return true;
+                    default:
+                        return false;
+                    }
+                });
+            schema.emplace_back(std::move(element));
+        };
+
+    std::vector<int64_t> rowGroupRows;
+
+    reader.readStruct([&] (int16_t id, int type)
+        {
+            switch (id) {
+            case 2:
+                reader.readList(readSchemaElement);
+
+                // Now we know the schema, we can find the leaf columns
+                // before reading the row groups
+                {
+                    if (schema.empty())
+                        throw Exception("Parquet file has no schema");
+
+                    // Walk the tree, with a stack of the number of
+                    // children left at each level
+                    std::vector<std::pair<std::string, int> > stack;
+                    stack.emplace_back("", schema[0].numChildren);
+                    for (size_t i = 1;  i < schema.size();  ++i) {
+                        while (!stack.empty() && stack.back().second == 0)
+                            stack.pop_back();
+                        if (stack.empty())
+                            throw Exception("Parquet schema is invalid");
+                        --stack.back().second;
+
+                        const SchemaElement & element = schema[i];
+                        std::string name = stack.back().first.empty()
+                            ? element.name
+                            : stack.back().first + "." + element.name;
+
+                        if (element.numChildren > 0) {
+                            stack.emplace_back(name, element.numChildren);
+                            continue;
+                        }
+
+                        ParquetColumn column;
+                        column.name = std::move(name);
+                        column.isFlat = stack.size() == 1
+                            && element.repetition != REPEATED;
+                        column.isOptional = element.repetition == OPTIONAL;
+                        column.physicalType = element.type;
+                        column.typeLength = element.typeLength;
+                        column.scale = element.scale;
+                        column.chunkIndex = columns.size();
+                        setColumnKind(column, element, binaryAsString);
+                        columns.emplace_back(std::move(column));
+                    }
+                }
+                return true;
+            case 3:
+                numRows = reader.readInt();
+                return true;
+            case 4:
+                reader.readList([&] (int type)
+                    {
+                        ParquetRowGroup group;
+                        reader.readStruct([&] (int16_t id, int type)
+                            {
+                                switch (id) {
+                                case 1:
+                                    reader.readList([&] (int type)
+                                        {
+                                            size_t i = group.columns.size();
+                                            if (i >= columns.size())
+                                                throw Exception
+                                                    ("Parquet row group has "
+                                                     "too many columns");
+                                            group.columns.emplace_back
+                                                (readColumnChunk(reader,
+                                                                 columns[i]));
+                                        });
+                                    return true;
+                                case 3:
+                                    group.numRows = reader.readInt();
+                                    return true;
+                                default:
+                                    return false;
+                                }
+                            });
+                        if (group.columns.size() != columns.size())
+                            throw Exception("Parquet row group has the wrong "
+                                            "number of columns");
+                        rowGroups.emplace_back(std::move(group));
+                    });
+                return true;
+            default:
+                return false;
+            }
+        });
+
+    int64_t firstRow = 0;
+    for (auto & group: rowGroups) {
+        group.firstRow = firstRow;
+        firstRow += group.numRows;
+    }
+}
+
+std::vector<CellValue>
+ParquetFile::
+readColumn(size_t rowGroup, size_t columnNum) const
+{
+    ExcAssertLess(rowGroup, rowGroups.size());
+    ExcAssertLess(columnNum, columns.size());
+
+    const ParquetColumn & column = columns[columnNum];
+    const ParquetRowGroup & group = rowGroups[rowGroup];
+    const ParquetColumnChunk & chunk = group.columns[column.chunkIndex];
+
+    if (!column.isFlat)
+        throw Exception("Parquet column '" + column.name + "' is nested or "
+                        "repeated, which is not supported");
+
+    ParquetValueDecoder decoder(column);
+
+    // Some writers set the dictionary page offset to zero when there is
+    // none, so only trust it if it comes before the data
+    int64_t start = chunk.dataPageOffset;
+    if (chunk.dictionaryPageOffset > 0
+        && chunk.dictionaryPageOffset < chunk.dataPageOffset)
+        start = chunk.dictionaryPageOffset;
+    if (start < 4 || chunk.totalCompressedSize < 0
+        || start + chunk.totalCompressedSize > (int64_t)length)
+        throw Exception("Parquet column chunk is outside of the file");
+
+    ThriftCompactReader reader(data + start, chunk.totalCompressedSize);
+
+    std::vector<CellValue> result;
+    result.reserve(group.numRows);
+
+    std::vector<CellValue> dictionary;
+    bool hasDictionary = false;
+    std::vector<CellValue> values;
+    std::vector<uint32_t> levels;
+
+    while (result.size() < chunk.numValues && reader.remaining()) {
+        int pageType = -1;
+        int64_t uncompressedSize = 0, compressedSize = 0;
+        int64_t numValues = 0, numNulls = -1;
+        int encoding = PLAIN, levelEncoding = RLE;
+        int64_t defLevelsLength = 0, repLevelsLength = 0;
+        bool isCompressed = true;
+
+        auto readPageHeader = [&] (int16_t id, int type)
+            {
+                switch (id) {
+                case 1: numValues = reader.readInt();  return true;
+                case 2:
+                    // DataPageHeader: num_nulls; DataPageHeaderV2: encoding
+                    if (pageType == DATA_PAGE_V2)
+                        numNulls = reader.readInt();
+                    else encoding = reader.readInt();
+                    return true;
+                case 3:
+                    if (pageType == DATA_PAGE)
+                        levelEncoding = reader.readInt();
+                    else if (pageType == DATA_PAGE_V2)
+                        reader.readInt();  // num_rows
+                    else return false;
+                    return true;
+                case 4:
+                    if (pageType != DATA_PAGE_V2)
+                        return false;
+                    encoding = reader.readInt();
+                    return true;
+                case 5:
+                    if (pageType != DATA_PAGE_V2)
+                        return false;
+                    defLevelsLength = reader.readInt();
+                    return true;
+                case 6:
+                    if (pageType != DATA_PAGE_V2)
+                        return false;
+                    repLevelsLength = reader.readInt();
+                    return true;
+                case 7:
+                    if (pageType != DATA_PAGE_V2)
+                        return false;
+                    isCompressed = reader.readBool(type);
+                    return true;
+                default:
+                    return false;
+                }
+            };
+
+        reader.readStruct([&] (int16_t id, int type)
+            {
+                switch (id) {
+                case 1: pageType = reader.readInt();  return true;
+                case 2: uncompressedSize = reader.readInt();  return true;
+                case 3: compressedSize = reader.readInt();  return true;
+                case 5:
+                case 7:
+                case 8:
+                    // Data, dictionary and v2 data page headers
+                    reader.readStruct(readPageHeader);
+                    return true;
+                default:
+                    return false;
+                }
+            });
+
+        if (compressedSize < 0 || uncompressedSize < 0 || numValues < 0)
+            throw Exception("Parquet page header is invalid");
+
+        const char * pageData = reader.skip(compressedSize);
+
+        if (pageType == DICTIONARY_PAGE) {
+            std::string page = decompressPage(chunk.codec, pageData,
+                                              compressedSize,
+                                              uncompressedSize);
+            ByteReader pageReader(page.data(), page.size());
+            decoder.decode(PLAIN, pageReader, numValues, nullptr, dictionary);
+            hasDictionary = true;
+            continue;
+        }
+        else if (pageType != DATA_PAGE && pageType != DATA_PAGE_V2) {
+            // Index pages and anything else aren't needed
+            continue;
+        }
+
+        std::string page;
+        ByteReader pageReader;
+        ByteReader defLevelsReader;
+        bool hasDefLevels = column.isOptional;
+
+        if (pageType == DATA_PAGE) {
+            page = decompressPage(chunk.codec, pageData, compressedSize,
+                                  uncompressedSize);
+            pageReader = ByteReader(page.data(), page.size());
+            if (hasDefLevels) {
+                if (levelEncoding != RLE)
+                    throw Exception("Parquet level encoding %d is not "
+                                    "supported", levelEncoding);
+                uint32_t len = pageReader.readLittleEndian<uint32_t>();
+                defLevelsReader = ByteReader(pageReader.skip(len), len);
+            }
+        }
+        else {
+            // Levels are before the values, and never compressed
+            if (repLevelsLength + defLevelsLength > compressedSize)
+                throw Exception("Parquet page header is invalid");
+            const char * levelsEnd
+                = pageData + repLevelsLength + defLevelsLength;
+            defLevelsReader = ByteReader(pageData + repLevelsLength,
+                                         defLevelsLength);
+            size_t valuesLength = compressedSize - (levelsEnd - pageData);
+            if (isCompressed) {
+                page = decompressPage(chunk.codec, levelsEnd, valuesLength,
+                                      uncompressedSize - repLevelsLength
+                                      - defLevelsLength);
+                pageReader = ByteReader(page.data(), page.size());
+            }
+            else {
+                pageReader = ByteReader(levelsEnd, valuesLength);
+            }
+        }
+
+        size_t numNonNull = numValues;
+        if (hasDefLevels) {
+            decodeRleHybrid(defLevelsReader, 1, numValues, levels);
+            numNonNull = 0;
+            for (auto l: levels)
+                numNonNull += l;
+        }
+        if (numNulls >= 0 && numNonNull + numNulls != numValues)
+            throw Exception("Parquet page null count is inconsistent");
+
+        decoder.decode(encoding, pageReader, numNonNull,
+                       hasDictionary ? &dictionary : nullptr, values);
+
+        if (!hasDefLevels) {
+            for (auto & v: values)
+                result.emplace_back(std::move(v));
+        }
+        else {
+            size_t n = 0;
+            for (auto l: levels) {
+                if (l)
+                    result.emplace_back(std::move(values[n++]));
+                else result.emplace_back();
+            }
+        }
+    }
+
+    if (result.size() != group.numRows)
+        throw Exception("Parquet column '" + column.name + "' has "
+                        + std::to_string(result.size()) + " values in a row "
+                        "group of " + std::to_string(group.numRows) + " rows");
+
+    return result;
+}
+
+CellValue
+ParquetFile::
+decodeStatistic(size_t columnNum, const std::string & value) const
+{
+    ExcAssertLess(columnNum, columns.size());
+    const ParquetColumn & column = columns[columnNum];
+    ParquetValueDecoder decoder(column);
+
+    switch (column.physicalType) {
+    case TYPE_BOOLEAN:
+        if (value.size() != 1)
+            throw Exception("Parquet boolean statistic is invalid");
+        return value[0] & 1;
+    case TYPE_BYTE_ARRAY:
+        // Statistics don't have the length prefix
+        return decoder.fromBytes(value.data(), value.size());
+    default: {
+        ByteReader reader(value.data(), value.size());
+        return decoder.readPlain(reader);
+    }
+    }
+}
+
+} // namespace MLDB
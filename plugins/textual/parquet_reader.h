@@ -0,0 +1,156 @@
+/** parquet_reader.h                                               -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Reader for Apache Parquet files held in memory.
+*/
+
+#pragma once
+
+#include "mldb/sql/cell_value.h"
+#include <string>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARQUET COLUMN                                                            */
+/*****************************************************************************/
+
+/** A leaf column of the schema of a Parquet file, along with how its
+    values are turned into CellValues.
+*/
+
+struct ParquetColumn {
+    /// Kind of CellValue that the column's values are turned into
+    enum Kind {
+        BOOLEAN,          ///< 0 or 1
+        INTEGER,          ///< Signed integer
+        UNSIGNED,         ///< Unsigned integer
+        FLOAT,            ///< Floating point number
+        DECIMAL,          ///< Fixed point number, stored as a double
+        STRING,           ///< UTF-8 string
+        BLOB,             ///< Binary blob
+        DATE,             ///< Days since the epoch, stored as a timestamp
+        TIMESTAMP         ///< Time since the epoch in units of timeUnit
+    };
+
+    /// Dotted path of the column in the schema
+    std::string name;
+
+    /// Is it a column directly under the root, with at most one value per
+    /// row?  Nested and repeated columns can't be read.
+    bool isFlat = true;
+
+    /// Can the column be null?
+    bool isOptional = false;
+
+    /// Physical type, as in the Parquet Type enum
+    int physicalType = -1;
+
+    /// Length of the values of FIXED_LEN_BYTE_ARRAY columns
+    int typeLength = 0;
+
+    Kind kind = BLOB;
+
+    /// Scale of a DECIMAL column
+    int scale = 0;
+
+    /// Length of a unit of a TIMESTAMP column, in seconds; 0 for the
+    /// legacy INT96 timestamps
+    double timeUnit = 0;
+
+    /// Index of this column in the column chunks of each row group
+    int chunkIndex = -1;
+};
+
+
+/*****************************************************************************/
+/* PARQUET COLUMN CHUNK                                                      */
+/*****************************************************************************/
+
+/** The part of a column that is within a single row group. */
+
+struct ParquetColumnChunk {
+    int codec = 0;
+    int64_t numValues = 0;
+    int64_t dataPageOffset = -1;
+    int64_t dictionaryPageOffset = -1;
+    int64_t totalCompressedSize = 0;
+
+    /// Statistics from the footer, with the minimum and maximum in PLAIN
+    /// encoding.  The deprecated min and max fields are only used for
+    /// numeric columns, as their ordering of strings is undefined.
+    bool hasNullCount = false;
+    int64_t nullCount = 0;
+    bool hasMinMax = false;
+    std::string minValue;
+    std::string maxValue;
+};
+
+
+/*****************************************************************************/
+/* PARQUET ROW GROUP                                                         */
+/*****************************************************************************/
+
+struct ParquetRowGroup {
+    int64_t numRows = 0;
+
+    /// Number of the first row of the group within the file
+    int64_t firstRow = 0;
+
+    /// One per leaf column of the schema, in schema order
+    std::vector<ParquetColumnChunk> columns;
+};
+
+
+/*****************************************************************************/
+/* PARQUET FILE                                                              */
+/*****************************************************************************/
+
+/** A Parquet file, which must be entirely in memory (normally mapped) for
+    as long as this object is used.  The footer is parsed on construction,
+    and the values of a column of a row group are decoded on demand, so
+    only the columns that are needed are ever decompressed.
+
+    Flat schemas are supported, with the PLAIN, dictionary, RLE, delta
+    and byte stream split encodings, data pages of either version, and
+    the uncompressed, Snappy, gzip, zstd and raw LZ4 codecs.  Errors are
+    reported by throwing an exception.
+*/
+
+struct ParquetFile {
+
+    /** Parse the footer of the file in the given memory.  If
+        binaryAsString is true, BYTE_ARRAY columns without an annotation
+        are read as strings (as older writers didn't mark them) rather than
+        blobs.
+    */
+    ParquetFile(const char * data, size_t length,
+                bool binaryAsString = false);
+
+    /// Leaf columns of the schema, in order
+    std::vector<ParquetColumn> columns;
+
+    std::vector<ParquetRowGroup> rowGroups;
+
+    int64_t numRows = 0;
+
+    /** Decode all of the values of the given column in the given row
+        group.  There is one value per row, with null values empty.
+    */
+    std::vector<CellValue>
+    readColumn(size_t rowGroup, size_t column) const;
+
+    /** Decode the given PLAIN encoded value of the given column, as found
+        in the statistics.
+    */
+    CellValue decodeStatistic(size_t column, const std::string & value) const;
+
+private:
+    const char * data;
+    size_t length;
+};
+
+} // namespace MLDB
@@ -7,17 +7,31 @@
 LIBMLDB_TEXTUAL_PLUGIN_SOURCES:= \
 	textual_plugin.cc \
 	csv_export_procedure.cc \
+	arrow_export_procedure.cc \
 	csv_writer.cc \
 	json_importer.cc \
+	json_line_parser.cc \
 	importtext_procedure.cc \
+	importparquet_procedure.cc \
+	parquet_reader.cc \
 	sql_csv_scope.cc \
 	tokensplit.cc \
+	csv_structure.cc \
+
+ifeq ($(ARCH),x86_64)
+LIBMLDB_TEXTUAL_PLUGIN_SOURCES += csv_structure_avx2.cc
+endif
 
 
 LIBMLDB_TEXTUAL_PLUGIN_LINK:= \
+	mldb_tabular_plugin \
+	lz4 \
 
 $(eval $(call library,mldb_textual_plugin,$(LIBMLDB_TEXTUAL_PLUGIN_SOURCES),$(LIBMLDB_TEXTUAL_PLUGIN_LINK)))
 
+# Only called after checking that the CPU supports AVX2
+$(eval $(call set_single_compile_option,csv_structure_avx2.cc,-mavx2))
+
 #$(eval $(call set_compile_option,$(LIBMLDB_TEXTUAL_PLUGIN_SOURCES),-Imldb/textual/ext))
 
 #$(eval $(call mldb_plugin_library,textual,mldb_textual_plugin,$(LIBMLDB_TEXTUAL_PLUGIN_SOURCES),hubbub tinyxpath))
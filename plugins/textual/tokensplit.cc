@@ -16,6 +16,7 @@
 #include "types/structure_description.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/utils/log.h"
+#include <algorithm>
 
 using namespace std;
 
@@ -143,20 +144,20 @@ apply(const FunctionApplier & applier,
             Utf8String subString(startIt, it);
             bool found = false;
             bool startFound = false;
-            for (auto& token : dictionary) {
 
-                if (token == subString) {
-                    //found an exact token, but there could be a longer one
-                    found = true;
-                }
-                else if (token.startsWith(subString)) {
-                    //found a token that starts with the sub string
-                    startFound = true;
-                }
-                else if (found || startFound) {
-                    //because its sorted, we can stop here
-                    break;
-                }
+            //the dictionary is sorted, so the tokens that start with the
+            //sub string follow it, starting with the sub string itself
+            auto tokenIt = std::lower_bound(dictionary.begin(),
+                                            dictionary.end(), subString);
+            while (tokenIt != dictionary.end() && *tokenIt == subString) {
+                //found an exact token, but there could be a longer one
+                found = true;
+                ++tokenIt;
+            }
+            if (tokenIt != dictionary.end()
+                && tokenIt->startsWith(subString)) {
+                //found a token that starts with the sub string
+                startFound = true;
             }
 
             if (found) {
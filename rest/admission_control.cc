@@ -0,0 +1,343 @@
+/** admission_control.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Limits on the number of concurrent requests to REST routes.
+*/
+
+#include "admission_control.h"
+#include "mldb/rest/rest_request.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ADMISSION LIMITS                                                          */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(AdmissionLimits);
+
+AdmissionLimitsDescription::
+AdmissionLimitsDescription()
+{
+    addField("maxConcurrent", &AdmissionLimits::maxConcurrent,
+             "Number of requests that may run at the same time", 1);
+    addField("maxQueued", &AdmissionLimits::maxQueued,
+             "Number of requests that may wait for a running one to "
+             "finish before new ones are rejected", 0);
+    addField("maxWaitSeconds", &AdmissionLimits::maxWaitSeconds,
+             "Longest time that a request waits before it is rejected", 1.0);
+}
+
+
+/*****************************************************************************/
+/* ADMISSION CONTROL                                                         */
+/*****************************************************************************/
+
+namespace {
+
+std::vector<std::string> splitSegments(const std::string & path)
+{
+    std::vector<std::string> result;
+    size_t pos = 0;
+    while (pos < path.size()) {
+        if (path[pos] == '/') {
+            ++pos;
+            continue;
+        }
+        size_t end = path.find('/', pos);
+        if (end == std::string::npos)
+            end = path.size();
+        result.emplace_back(path, pos, end - pos);
+        pos = end;
+    }
+    return result;
+}
+
+} // file scope
+
+struct AdmissionControl::Rule {
+    Rule(std::string route, const AdmissionLimits & limits)
+        : route(std::move(route)), segments(splitSegments(this->route)),
+          limits(limits)
+    {
+    }
+
+    std::string route;
+    std::vector<std::string> segments;
+    AdmissionLimits limits;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    int running = 0;
+    std::deque<uint64_t> waiting;   ///< Requests in the queue, in order
+    uint64_t nextRequest = 0;
+
+    uint64_t admitted = 0;
+    uint64_t queued = 0;            ///< Requests that had to wait
+    uint64_t rejectedQueueFull = 0;
+    uint64_t rejectedTimeout = 0;
+    double totalWaitSeconds = 0;
+    size_t peakQueued = 0;
+
+    /// Does the rule cover the given resource?
+    bool matches(const std::string & resource) const
+    {
+        size_t pos = 0;
+        for (auto & s: segments) {
+            while (pos < resource.size() && resource[pos] == '/')
+                ++pos;
+            size_t end = resource.find('/', pos);
+            if (end == std::string::npos)
+                end = resource.size();
+            if (end == pos)
+                return false;
+            if (s != "*" && resource.compare(pos, end - pos, s) != 0)
+                return false;
+            pos = end;
+        }
+        return true;
+    }
+
+    void release()
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            --running;
+        }
+        changed.notify_all();
+    }
+};
+
+AdmissionControl::
+AdmissionControl()
+{
+}
+
+AdmissionControl::
+~AdmissionControl()
+{
+}
+
+void
+AdmissionControl::
+setLimits(const std::string & route, const AdmissionLimits & limits)
+{
+    if (limits.maxConcurrent < 1)
+        throw AnnotatedException(400, "maxConcurrent must be at least 1",
+                                 "route", route,
+                                 "maxConcurrent", limits.maxConcurrent);
+    if (limits.maxQueued < 0 || limits.maxWaitSeconds < 0)
+        throw AnnotatedException(400, "maxQueued and maxWaitSeconds must "
+                                 "not be negative",
+                                 "route", route);
+
+    auto rule = std::make_shared<Rule>(route, limits);
+
+    std::unique_lock<std::mutex> guard(mutex);
+    for (auto & r: rules) {
+        if (r->segments == rule->segments) {
+            r = rule;
+            return;
+        }
+    }
+    rules.emplace_back(std::move(rule));
+}
+
+bool
+AdmissionControl::
+removeLimits(const std::string & route)
+{
+    auto segments = splitSegments(route);
+
+    std::unique_lock<std::mutex> guard(mutex);
+    for (auto it = rules.begin();  it != rules.end();  ++it) {
+        if ((*it)->segments == segments) {
+            rules.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+AdmissionControl::
+parseLimits(const std::string & spec)
+{
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t end = spec.find(',', pos);
+        if (end == std::string::npos)
+            end = spec.size();
+        std::string rule(spec, pos, end - pos);
+        pos = end + 1;
+        if (rule.empty())
+            continue;
+
+        size_t equals = rule.find('=');
+        if (equals == std::string::npos)
+            throw AnnotatedException(400, "admission limit must look like "
+                                     "route=maxConcurrent[:maxQueued"
+                                     "[:maxWaitSeconds]]",
+                                     "rule", rule);
+
+        AdmissionLimits limits;
+        char * p = &rule[equals + 1];
+        char * e = nullptr;
+        limits.maxConcurrent = strtol(p, &e, 10);
+        bool ok = e != p;
+        if (ok && *e == ':') {
+            p = e + 1;
+            limits.maxQueued = strtol(p, &e, 10);
+            ok = e != p;
+        }
+        if (ok && *e == ':') {
+            p = e + 1;
+            limits.maxWaitSeconds = strtod(p, &e);
+            ok = e != p;
+        }
+        if (!ok || *e != 0)
+            throw AnnotatedException(400, "couldn't parse admission limit",
+                                     "rule", rule);
+
+        setLimits(rule.substr(0, equals), limits);
+    }
+}
+
+std::shared_ptr<AdmissionControl::Rule>
+AdmissionControl::
+findRule(const std::string & resource) const
+{
+    std::shared_ptr<Rule> result;
+
+    std::unique_lock<std::mutex> guard(mutex);
+    for (auto & r: rules) {
+        if ((!result || r->segments.size() > result->segments.size())
+            && r->matches(resource))
+            result = r;
+    }
+    return result;
+}
+
+AdmissionControl::Outcome
+AdmissionControl::
+admit(const RestRequest & request, std::shared_ptr<void> & ticket)
+{
+    ticket.reset();
+
+    std::shared_ptr<Rule> rule = findRule(request.resource);
+    if (!rule)
+        return ADMITTED;
+
+    auto makeTicket = [&] ()
+        {
+            ticket = std::shared_ptr<void>(rule.get(),
+                                           [rule] (void *) { rule->release(); });
+        };
+
+    std::unique_lock<std::mutex> guard(rule->mutex);
+
+    if (rule->running < rule->limits.maxConcurrent && rule->waiting.empty()) {
+        ++rule->running;
+        ++rule->admitted;
+        makeTicket();
+        return ADMITTED;
+    }
+
+    if (rule->waiting.size() >= rule->limits.maxQueued) {
+        ++rule->rejectedQueueFull;
+        return QUEUE_FULL;
+    }
+
+    double waitSeconds = rule->limits.maxWaitSeconds;
+    const std::string & timeout = request.header.tryGetHeader("x-request-timeout");
+    if (!timeout.empty()) {
+        char * end = nullptr;
+        double requested = strtod(timeout.c_str(), &end);
+        if (end != timeout.c_str())
+            waitSeconds = std::max(0.0, std::min(waitSeconds, requested));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline
+        = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>
+          (std::chrono::duration<double>(waitSeconds));
+
+    uint64_t me = rule->nextRequest++;
+    rule->waiting.push_back(me);
+    ++rule->queued;
+    rule->peakQueued = std::max(rule->peakQueued, rule->waiting.size());
+
+    auto myTurn = [&] ()
+        {
+            return rule->waiting.front() == me
+                && rule->running < rule->limits.maxConcurrent;
+        };
+
+    bool admitted = rule->changed.wait_until(guard, deadline, myTurn);
+
+    std::chrono::duration<double> waited
+        = std::chrono::steady_clock::now() - start;
+    rule->totalWaitSeconds += waited.count();
+
+    if (admitted) {
+        rule->waiting.pop_front();
+        ++rule->running;
+        ++rule->admitted;
+        makeTicket();
+    }
+    else {
+        rule->waiting.erase(std::find(rule->waiting.begin(),
+                                      rule->waiting.end(), me));
+        ++rule->rejectedTimeout;
+    }
+
+    guard.unlock();
+
+    // Whoever is now at the front of the queue may be able to run
+    rule->changed.notify_all();
+
+    return admitted ? ADMITTED : TIMED_OUT;
+}
+
+Json::Value
+AdmissionControl::
+getStats() const
+{
+    std::vector<std::shared_ptr<Rule> > currentRules;
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        currentRules = rules;
+    }
+
+    Json::Value result(Json::objectValue);
+    for (auto & r: currentRules) {
+        std::unique_lock<std::mutex> guard(r->mutex);
+        Json::Value & stats = result[r->route];
+        stats["maxConcurrent"] = r->limits.maxConcurrent;
+        stats["maxQueued"] = r->limits.maxQueued;
+        stats["maxWaitSeconds"] = r->limits.maxWaitSeconds;
+        stats["running"] = r->running;
+        stats["waiting"] = r->waiting.size();
+        stats["peakWaiting"] = r->peakQueued;
+        stats["admitted"] = r->admitted;
+        stats["queued"] = r->queued;
+        stats["rejectedQueueFull"] = r->rejectedQueueFull;
+        stats["rejectedTimeout"] = r->rejectedTimeout;
+        stats["meanWaitSeconds"]
+            = r->queued ? r->totalWaitSeconds / r->queued : 0.0;
+    }
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,108 @@
+/** admission_control.h                                            -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Limits on the number of concurrent requests to REST routes.
+*/
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "mldb/ext/jsoncpp/json.h"
+#include "mldb/types/value_description_fwd.h"
+
+namespace MLDB {
+
+struct RestRequest;
+
+
+/*****************************************************************************/
+/* ADMISSION LIMITS                                                          */
+/*****************************************************************************/
+
+/** Limits applied to the requests that match a route. */
+
+struct AdmissionLimits {
+    /// Number of requests that may run at the same time
+    int maxConcurrent = 1;
+
+    /// Number of requests that may wait for one of those to finish; once
+    /// there are that many, new requests are rejected straight away
+    int maxQueued = 0;
+
+    /// Longest time that a request waits before it is rejected.  A client
+    /// may ask for less with the X-Request-Timeout header.
+    double maxWaitSeconds = 1.0;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(AdmissionLimits);
+
+
+/*****************************************************************************/
+/* ADMISSION CONTROL                                                         */
+/*****************************************************************************/
+
+/** Admission control for REST requests.  Each rule covers the requests
+    whose resource starts with its route, compared segment by segment,
+    where a segment of "*" matches any one segment, so that one rule can
+    cover the application of every function.  When several rules match a
+    request, the one with the most segments is used.
+
+    A request that finds its rule at its concurrency limit waits in a
+    first-in, first-out queue, blocking its thread, until a running one
+    finishes.  If the queue is full or its deadline passes first, it is
+    rejected so that the client can back off instead of everything slowing
+    down together.
+*/
+
+struct AdmissionControl {
+    AdmissionControl();
+    ~AdmissionControl();
+
+    /** Add a rule for the given route, or replace the limits of an
+        existing one.  Requests that are already waiting keep the limits
+        that they started with.
+    */
+    void setLimits(const std::string & route, const AdmissionLimits & limits);
+
+    /** Remove the rule for the given route.  Returns false if there was
+        none.
+    */
+    bool removeLimits(const std::string & route);
+
+    /** Add rules from a string like "/v1/query=4:16:10,/v1/datasets=8",
+        where each rule is route=maxConcurrent[:maxQueued[:maxWaitSeconds]].
+    */
+    void parseLimits(const std::string & spec);
+
+    /// Why a request wasn't admitted
+    enum Outcome {
+        ADMITTED,      ///< Request may run
+        QUEUE_FULL,    ///< Too many requests were already waiting
+        TIMED_OUT      ///< Request waited until its deadline
+    };
+
+    /** Wait until the request may run.  If it's admitted, ticket holds its
+        place until it's destroyed; requests that no rule covers are always
+        admitted and get a null ticket.  Whatever ticket was passed in is
+        released first.
+    */
+    Outcome admit(const RestRequest & request,
+                  std::shared_ptr<void> & ticket);
+
+    /** Return, for each rule, its limits, how many requests are running
+        and waiting, and how many were admitted and rejected.
+    */
+    Json::Value getStats() const;
+
+private:
+    struct Rule;
+    mutable std::mutex mutex;
+    std::vector<std::shared_ptr<Rule> > rules;
+
+    std::shared_ptr<Rule> findRule(const std::string & resource) const;
+};
+
+} // namespace MLDB
@@ -10,6 +10,12 @@
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/vfs/filter_streams.h"
+#include "mldb/arch/exception.h"
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 
 
 using namespace std;
@@ -26,15 +32,192 @@ CollectionConfigStore::
 {
 }
 
+void
+CollectionConfigStore::
+sync()
+{
+}
+
 
 /*****************************************************************************/
 /* S3 COLLECTION CONFIG STORE                                                */
 /*****************************************************************************/
 
+struct S3CollectionConfigStore::WriteBehind {
+    WriteBehind(S3CollectionConfigStore * owner, double flushIntervalSeconds)
+        : owner(owner),
+          snapshotUri(owner->baseUri + ".snapshot.json"),
+          flushInterval(flushIntervalSeconds)
+    {
+    }
+
+    ~WriteBehind()
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            shutdown = true;
+        }
+        changed.notify_all();
+        if (flusher.joinable())
+            flusher.join();
+    }
+
+    S3CollectionConfigStore * owner;
+    std::string snapshotUri;
+    std::chrono::duration<double> flushInterval;
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::map<Utf8String, Json::Value> entries;
+
+    /// Keys stored one per object, to erase once the snapshot is written
+    std::vector<Utf8String> legacyKeys;
+
+    uint64_t generation = 0;         ///< Bumped by each change
+    uint64_t flushedGeneration = 0;  ///< Last one that is durable
+    uint64_t syncGeneration = 0;     ///< Flush now up to this one
+    uint64_t triedGeneration = 0;    ///< Last one a flush was tried for
+    std::exception_ptr flushError;   ///< Of the last flush, if it failed
+    bool shutdown = false;
+    std::thread flusher;
+
+    void load()
+    {
+        // Those stored one by one are older than anything in the snapshot
+        for (auto & key: owner->keysInDirectory()) {
+            entries[key] = owner->readObject(key);
+            legacyKeys.push_back(key);
+        }
+
+        if (tryGetUriObjectInfo(snapshotUri).exists) {
+            filter_istream stream(snapshotUri);
+            Json::Value snapshot;
+            stream >> snapshot;
+            if (snapshot["version"].asInt() != 1)
+                throw MLDB::Exception("unknown version of config snapshot "
+                                      + snapshotUri);
+            const Json::Value & snapshotEntries = snapshot["entries"];
+            for (auto & key: snapshotEntries.getMemberNamesUtf8())
+                entries[key] = snapshotEntries.atStr(key);
+        }
+
+        if (!legacyKeys.empty())
+            ++generation;
+
+        flusher = std::thread([this] () { run(); });
+    }
+
+    void recordChange(std::unique_lock<std::mutex> & guard)
+    {
+        bool wasClean = generation == flushedGeneration;
+        ++generation;
+        if (wasClean)
+            changed.notify_all();
+    }
+
+    /** Write out everything up to the current generation.  Called with the
+        lock held, which is released while writing.
+    */
+    void flush(std::unique_lock<std::mutex> & guard)
+    {
+        uint64_t flushing = generation;
+        Json::Value snapshot;
+        snapshot["version"] = 1;
+        Json::Value & snapshotEntries = snapshot["entries"];
+        snapshotEntries = Json::Value(Json::objectValue);
+        for (auto & e: entries)
+            snapshotEntries.atStr(e.first) = e.second;
+        std::vector<Utf8String> toErase = legacyKeys;
+
+        guard.unlock();
+        std::exception_ptr error;
+        try {
+            filter_ostream stream(snapshotUri);
+            stream << snapshot;
+            stream.close();
+            for (auto & key: toErase)
+                owner->eraseObject(key);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        guard.lock();
+
+        flushError = error;
+        triedGeneration = flushing;
+        if (!error) {
+            flushedGeneration = flushing;
+            legacyKeys.clear();
+        }
+        changed.notify_all();
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        for (;;) {
+            changed.wait(guard, [&] ()
+                         {
+                             return shutdown || generation != flushedGeneration;
+                         });
+            if (generation == flushedGeneration)
+                return;  // shutdown with nothing to write
+
+            // Gather up the changes that follow the first one, unless
+            // someone is waiting for them
+            changed.wait_for(guard, flushInterval, [&] ()
+                             {
+                                 return shutdown
+                                     || syncGeneration > flushedGeneration;
+                             });
+
+            flush(guard);
+
+            if (flushError) {
+                if (shutdown) {
+                    cerr << "error writing config snapshot " << snapshotUri
+                         << " on shutdown: "
+                         << getExceptionString() << endl;
+                    return;
+                }
+                // Try again after an interval, so as to not hammer a store
+                // that is down
+                changed.wait_for(guard, flushInterval, [&] ()
+                                 {
+                                     return shutdown
+                                         || syncGeneration > triedGeneration;
+                                 });
+            }
+        }
+    }
+
+    void sync()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        uint64_t target = generation;
+        if (flushedGeneration >= target)
+            return;
+        syncGeneration = std::max(syncGeneration, target);
+        changed.notify_all();
+        changed.wait(guard, [&] ()
+                     {
+                         return flushedGeneration >= target
+                             || (flushError && triedGeneration >= target);
+                     });
+        if (flushedGeneration < target)
+            std::rethrow_exception(flushError);
+    }
+};
+
+S3CollectionConfigStore::
+S3CollectionConfigStore()
+{
+}
+
 S3CollectionConfigStore::
-S3CollectionConfigStore(const std::string & baseUri)
+S3CollectionConfigStore(const std::string & baseUri,
+                        double flushIntervalSeconds)
 {
-    init(baseUri);
+    init(baseUri, flushIntervalSeconds);
 }
 
 S3CollectionConfigStore::
@@ -44,7 +227,7 @@ S3CollectionConfigStore::
 
 void
 S3CollectionConfigStore::
-init(const std::string & baseUri)
+init(const std::string & baseUri, double flushIntervalSeconds)
 {
     if (baseUri.empty())
         throw MLDB::Exception("can't do empty uri");
@@ -55,11 +238,32 @@ init(const std::string & baseUri)
     else this->baseUri = baseUri;
 
     makeUriDirectory(baseUri + "/");
+
+    writeBehind.reset();
+    if (flushIntervalSeconds > 0.0) {
+        writeBehind.reset(new WriteBehind(this, flushIntervalSeconds));
+        writeBehind->load();
+    }
 }
 
 std::vector<Utf8String>
 S3CollectionConfigStore::
 keys() const
+{
+    if (writeBehind) {
+        std::unique_lock<std::mutex> guard(writeBehind->mutex);
+        vector<Utf8String> result;
+        for (auto & e: writeBehind->entries)
+            result.push_back(e.first);
+        return result;
+    }
+
+    return keysInDirectory();
+}
+
+std::vector<Utf8String>
+S3CollectionConfigStore::
+keysInDirectory() const
 {
     vector<Utf8String> result;
 
@@ -95,6 +299,13 @@ void
 S3CollectionConfigStore::
 set(Utf8String key, const Json::Value & config)
 {
+    if (writeBehind) {
+        std::unique_lock<std::mutex> guard(writeBehind->mutex);
+        writeBehind->entries[key] = config;
+        writeBehind->recordChange(guard);
+        return;
+    }
+
     filter_ostream stream((baseUri + "/" + key).rawString());
     stream << config;
 }
@@ -103,10 +314,16 @@ Json::Value
 S3CollectionConfigStore::
 get(Utf8String key) const
 {
-    filter_istream stream((baseUri + "/" + key).rawString());
-    Json::Value val;
-    stream >> val;
-    return val;
+    if (writeBehind) {
+        std::unique_lock<std::mutex> guard(writeBehind->mutex);
+        auto it = writeBehind->entries.find(key);
+        if (it == writeBehind->entries.end())
+            throw MLDB::Exception("no configuration stored for "
+                                  + key.rawString() + " in " + baseUri);
+        return it->second;
+    }
+
+    return readObject(key);
 }
 
 std::vector<std::pair<Utf8String, Json::Value> >
@@ -114,6 +331,14 @@ S3CollectionConfigStore::
 getAll() const
 {
     vector<pair<Utf8String, Json::Value> > result;
+
+    if (writeBehind) {
+        std::unique_lock<std::mutex> guard(writeBehind->mutex);
+        for (auto & e: writeBehind->entries)
+            result.push_back(e);
+        return result;
+    }
+
     for (const Utf8String & key: keys())
         result.push_back(make_pair(key, get(key)));
     return result;
@@ -123,6 +348,13 @@ void
 S3CollectionConfigStore::
 clear()
 {
+    if (writeBehind) {
+        std::unique_lock<std::mutex> guard(writeBehind->mutex);
+        writeBehind->entries.clear();
+        writeBehind->recordChange(guard);
+        return;
+    }
+
     for (const Utf8String & key: keys())
         erase(key);
 }
@@ -130,6 +362,38 @@ clear()
 void
 S3CollectionConfigStore::
 erase(Utf8String key)
+{
+    if (writeBehind) {
+        std::unique_lock<std::mutex> guard(writeBehind->mutex);
+        if (writeBehind->entries.erase(key))
+            writeBehind->recordChange(guard);
+        return;
+    }
+
+    eraseObject(key);
+}
+
+void
+S3CollectionConfigStore::
+sync()
+{
+    if (writeBehind)
+        writeBehind->sync();
+}
+
+Json::Value
+S3CollectionConfigStore::
+readObject(const Utf8String & key) const
+{
+    filter_istream stream((baseUri + "/" + key).rawString());
+    Json::Value val;
+    stream >> val;
+    return val;
+}
+
+void
+S3CollectionConfigStore::
+eraseObject(const Utf8String & key) const
 {
     tryEraseUriObject((baseUri + "/" + key).rawString());
 }
@@ -9,6 +9,7 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 #include "mldb/ext/jsoncpp/json.h"
 
 namespace MLDB {
@@ -27,6 +28,13 @@ struct CollectionConfigStore {
     virtual std::vector<std::pair<Utf8String, Json::Value> > getAll() const = 0;
     virtual void clear() = 0;
     virtual void erase(Utf8String key) = 0;
+
+    /** Durability fence: returns once every set(), erase() and clear()
+        made before the call has been stored permanently, or throws if it
+        couldn't be.  Default does nothing, for stores that write
+        synchronously.
+    */
+    virtual void sync();
 };
 
 
@@ -34,17 +42,33 @@ struct CollectionConfigStore {
 /* S3 COLLECTION CONFIG STORE                                                */
 /*****************************************************************************/
 
-/** Store configuration of a collection of objects in S3. */
+/** Store configuration of a collection of objects in S3 (or any other
+    URI that can be written to).
+
+    By default, each configuration is a separate object under baseUri,
+    which is written or erased before set() or erase() returns.
+
+    With a flushIntervalSeconds above zero, the store is write-behind
+    instead: the configurations are kept in memory, and all of the
+    changes made since the last flush are written together, at most
+    flushIntervalSeconds after the first of them, as a single snapshot
+    object next to baseUri (baseUri + ".snapshot.json").  That object is
+    all that getAll() needs to read on startup.  Configurations stored
+    one per object by an earlier synchronous store are picked up, and
+    erased once the first snapshot is written.  Use sync() where a change
+    must be durable before carrying on.
+*/
 
 struct S3CollectionConfigStore : public CollectionConfigStore {
-    S3CollectionConfigStore()
-    {
-    }
+    S3CollectionConfigStore();
 
-    S3CollectionConfigStore(const std::string & baseUri);
+    S3CollectionConfigStore(const std::string & baseUri,
+                            double flushIntervalSeconds = 0.0);
 
-    void init(const std::string & baseUri);
+    void init(const std::string & baseUri,
+              double flushIntervalSeconds = 0.0);
 
+    /** Writes out anything that is still pending. */
     virtual ~S3CollectionConfigStore();
     virtual std::vector<Utf8String> keys() const;
     virtual void set(Utf8String key, const Json::Value & config);
@@ -52,8 +76,20 @@ struct S3CollectionConfigStore : public CollectionConfigStore {
     virtual std::vector<std::pair<Utf8String, Json::Value> > getAll() const;
     virtual void clear();
     virtual void erase(Utf8String key);
+    virtual void sync();
+
+    /** Is this store write-behind? */
+    bool isWriteBehind() const { return !!writeBehind; }
 
     std::string baseUri;  // UTF-8 encoded
+
+private:
+    std::vector<Utf8String> keysInDirectory() const;
+    Json::Value readObject(const Utf8String & key) const;
+    void eraseObject(const Utf8String & key) const;
+
+    struct WriteBehind;
+    std::unique_ptr<WriteBehind> writeBehind;
 };
 
 
@@ -0,0 +1,396 @@
+/** entity_restorer.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Restoration of the entities of collections from their stored
+    configuration.
+*/
+
+#include "entity_restorer.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/enum_description.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/timers.h"
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <map>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ENTITY RESTORE STATUS                                                     */
+/*****************************************************************************/
+
+DEFINE_ENUM_DESCRIPTION(EntityRestoreState);
+
+EntityRestoreStateDescription::
+EntityRestoreStateDescription()
+{
+    addValue("waiting", EntityRestoreState::WAITING,
+             "Waiting for its dependencies or for a free thread");
+    addValue("loading", EntityRestoreState::LOADING,
+             "Being created");
+    addValue("loaded", EntityRestoreState::LOADED,
+             "Created, and ready to be used");
+    addValue("failed", EntityRestoreState::FAILED,
+             "Couldn't be created");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(EntityRestoreStatus);
+
+EntityRestoreStatusDescription::
+EntityRestoreStatusDescription()
+{
+    addField("collection", &EntityRestoreStatus::collection,
+             "Collection of the entity, like datasets");
+    addField("id", &EntityRestoreStatus::id,
+             "Name of the entity in its collection");
+    addField("state", &EntityRestoreStatus::state,
+             "Where the restoration of the entity is at");
+    addField("dependsOn", &EntityRestoreStatus::dependsOn,
+             "Entities, as collection/id, that are restored first");
+    addField("loadingSeconds", &EntityRestoreStatus::loadingSeconds,
+             "Time spent creating the entity so far");
+    addField("error", &EntityRestoreStatus::error,
+             "Why the entity couldn't be created");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(EntityRestorerStatus);
+
+EntityRestorerStatusDescription::
+EntityRestorerStatusDescription()
+{
+    addField("ready", &EntityRestorerStatus::ready,
+             "Every entity has been restored, or has failed");
+    addField("numWaiting", &EntityRestorerStatus::numWaiting,
+             "Entities that haven't started loading");
+    addField("numLoading", &EntityRestorerStatus::numLoading,
+             "Entities that are loading");
+    addField("numLoaded", &EntityRestorerStatus::numLoaded,
+             "Entities that are ready");
+    addField("numFailed", &EntityRestorerStatus::numFailed,
+             "Entities that couldn't be restored");
+    addField("entities", &EntityRestorerStatus::entities,
+             "Status of each entity");
+}
+
+
+/*****************************************************************************/
+/* ENTITY RESTORER                                                           */
+/*****************************************************************************/
+
+struct EntityRestorer::Itl {
+    struct Entity {
+        EntityRestoreStatus status;
+        Json::Value config;
+        std::function<void ()> restore;
+        int phase;
+        std::vector<size_t> dependsOn;
+        Timer timer;   ///< Started when it starts loading
+    };
+
+    Itl(int maxConcurrency)
+        : maxConcurrency(std::max(maxConcurrency, 1))
+    {
+    }
+
+    int maxConcurrency;
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<Entity> entities;
+    std::vector<std::thread> threads;
+    bool started = false;
+    bool cancelled = false;
+    size_t numFinished = 0;
+    size_t numLoading = 0;
+
+    static bool isFinished(const Entity & entity)
+    {
+        return entity.status.state == EntityRestoreState::LOADED
+            || entity.status.state == EntityRestoreState::FAILED;
+    }
+
+    bool isReady(const Entity & entity) const
+    {
+        for (auto & e: entities) {
+            if (e.phase < entity.phase && !isFinished(e))
+                return false;
+        }
+        for (size_t d: entity.dependsOn) {
+            if (!isFinished(entities[d]))
+                return false;
+        }
+        return true;
+    }
+
+    /** Return the next entity to load, or -1 if there is none that can
+        be loaded now.  Called with the mutex held.
+    */
+    ssize_t findNext()
+    {
+        ssize_t firstWaiting = -1;
+        for (size_t i = 0;  i < entities.size();  ++i) {
+            auto & entity = entities[i];
+            if (entity.status.state != EntityRestoreState::WAITING)
+                continue;
+            if (firstWaiting == -1 || entity.phase < entities[firstWaiting].phase)
+                firstWaiting = i;
+            if (isReady(entity))
+                return i;
+        }
+
+        // If nothing is loading and nothing waiting is ready, the ones that
+        // are waiting depend on each other; break the cycle with the first
+        // one of the earliest phase
+        if (firstWaiting != -1 && numLoading == 0) {
+            auto & entity = entities[firstWaiting];
+            if (!isReady(entity)) {
+                cerr << "warning: breaking a dependency cycle to restore "
+                     << entity.status.collection << "/" << entity.status.id
+                     << endl;
+                // Only the dependencies on its own phase may be part of
+                // the cycle, as earlier phases are finished
+                entity.dependsOn.clear();
+            }
+            return firstWaiting;
+        }
+
+        return -1;
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+
+        for (;;) {
+            ssize_t next = -1;
+            while (!cancelled && numFinished < entities.size()
+                   && (next = findNext()) == -1) {
+                changed.wait(guard);
+            }
+            if (cancelled || next == -1)
+                return;
+
+            Entity & entity = entities[next];
+            entity.status.state = EntityRestoreState::LOADING;
+            entity.timer.restart();
+            ++numLoading;
+
+            guard.unlock();
+            bool failed = true;
+            Utf8String error;
+            try {
+                entity.restore();
+                failed = false;
+            } catch (const std::exception & exc) {
+                error = exc.what();
+            } catch (...) {
+                error = getExceptionString();
+            }
+            guard.lock();
+
+            entity.status.loadingSeconds = entity.timer.elapsed_wall();
+            if (!failed) {
+                entity.status.state = EntityRestoreState::LOADED;
+            }
+            else {
+                cerr << "error restoring " << entity.status.collection
+                     << "/" << entity.status.id << ": " << error << endl;
+                entity.status.state = EntityRestoreState::FAILED;
+                entity.status.error = std::move(error);
+            }
+            --numLoading;
+            ++numFinished;
+            changed.notify_all();
+        }
+    }
+
+    void findDependencies()
+    {
+        std::set<Utf8String> names;
+        std::map<Utf8String, std::vector<size_t> > byName;
+        for (size_t i = 0;  i < entities.size();  ++i) {
+            names.insert(entities[i].status.id);
+            byName[entities[i].status.id].push_back(i);
+        }
+
+        for (size_t i = 0;  i < entities.size();  ++i) {
+            auto & entity = entities[i];
+
+            // The type and id are about the entity itself; what it uses is
+            // in its parameters
+            const Json::Value & params
+                = entity.config.isObject() && entity.config.isMember("params")
+                ? entity.config["params"] : entity.config;
+
+            for (auto & name: findReferences(params, names)) {
+                for (size_t j: byName[name]) {
+                    // Later phases wait for the earlier ones anyway, and
+                    // the earlier ones mustn't wait for the later ones
+                    if (j == i || entities[j].phase != entity.phase)
+                        continue;
+                    entity.dependsOn.push_back(j);
+                    entity.status.dependsOn.push_back
+                        (entities[j].status.collection + "/"
+                         + entities[j].status.id);
+                }
+            }
+        }
+    }
+};
+
+EntityRestorer::
+EntityRestorer(int maxConcurrency)
+    : itl(new Itl(maxConcurrency))
+{
+}
+
+EntityRestorer::
+~EntityRestorer()
+{
+    cancel();
+    for (auto & t: itl->threads)
+        t.join();
+}
+
+void
+EntityRestorer::
+add(Utf8String collection, Utf8String id, Json::Value config,
+    std::function<void ()> restore, int phase)
+{
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    ExcAssert(!itl->started);
+
+    Itl::Entity entity;
+    entity.status.collection = std::move(collection);
+    entity.status.id = std::move(id);
+    entity.config = std::move(config);
+    entity.restore = std::move(restore);
+    entity.phase = phase;
+    itl->entities.emplace_back(std::move(entity));
+}
+
+void
+EntityRestorer::
+start()
+{
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    ExcAssert(!itl->started);
+    itl->started = true;
+
+    itl->findDependencies();
+
+    int numThreads = std::min<size_t>(itl->maxConcurrency,
+                                      itl->entities.size());
+    for (int i = 0;  i < numThreads;  ++i)
+        itl->threads.emplace_back([this] () { itl->run(); });
+}
+
+void
+EntityRestorer::
+wait()
+{
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    ExcAssert(itl->started);
+    while (itl->numFinished < itl->entities.size()
+           && !(itl->cancelled && itl->numLoading == 0)) {
+        itl->changed.wait(guard);
+    }
+}
+
+void
+EntityRestorer::
+cancel()
+{
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    itl->cancelled = true;
+    itl->changed.notify_all();
+}
+
+EntityRestorerStatus
+EntityRestorer::
+getStatus() const
+{
+    std::unique_lock<std::mutex> guard(itl->mutex);
+
+    EntityRestorerStatus result;
+    for (auto & entity: itl->entities) {
+        result.entities.push_back(entity.status);
+        switch (entity.status.state) {
+        case EntityRestoreState::WAITING:
+            ++result.numWaiting;
+            break;
+        case EntityRestoreState::LOADING:
+            ++result.numLoading;
+            result.entities.back().loadingSeconds
+                = entity.timer.elapsed_wall();
+            break;
+        case EntityRestoreState::LOADED:
+            ++result.numLoaded;
+            break;
+        case EntityRestoreState::FAILED:
+            ++result.numFailed;
+            break;
+        }
+    }
+    result.ready = itl->started && itl->numFinished == itl->entities.size();
+    return result;
+}
+
+namespace {
+
+bool isIdentifierChar(char c)
+{
+    return isalnum(c) || c == '_';
+}
+
+void findReferencesIn(const Json::Value & val,
+                      const std::set<Utf8String> & names,
+                      std::set<Utf8String> & result)
+{
+    if (val.isString()) {
+        const std::string str = val.asString();
+        for (auto & name: names) {
+            if (result.count(name))
+                continue;
+            const std::string & n = name.rawString();
+            if (n.empty())
+                continue;
+            for (size_t pos = str.find(n);  pos != std::string::npos;
+                 pos = str.find(n, pos + 1)) {
+                size_t end = pos + n.size();
+                if ((pos == 0 || !isIdentifierChar(str[pos - 1]))
+                    && (end == str.size() || !isIdentifierChar(str[end]))) {
+                    result.insert(name);
+                    break;
+                }
+            }
+        }
+    }
+    else if (val.isArray() || val.isObject()) {
+        for (auto & v: val)
+            findReferencesIn(v, names, result);
+    }
+}
+
+} // file scope
+
+std::set<Utf8String>
+EntityRestorer::
+findReferences(const Json::Value & config,
+               const std::set<Utf8String> & names)
+{
+    std::set<Utf8String> result;
+    findReferencesIn(config, names, result);
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,117 @@
+/** entity_restorer.h                                              -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Restoration of the entities of collections from their stored
+    configuration, in parallel and in the order of their dependencies.
+*/
+
+#pragma once
+
+#include <memory>
+#include <functional>
+#include <set>
+#include <vector>
+#include "mldb/types/string.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include "mldb/types/value_description_fwd.h"
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ENTITY RESTORE STATUS                                                     */
+/*****************************************************************************/
+
+enum class EntityRestoreState {
+    WAITING,   ///< For its dependencies or a free thread
+    LOADING,
+    LOADED,
+    FAILED
+};
+
+DECLARE_ENUM_DESCRIPTION(EntityRestoreState);
+
+/** Where the restoration of one entity is at. */
+struct EntityRestoreStatus {
+    Utf8String collection;
+    Utf8String id;
+    EntityRestoreState state = EntityRestoreState::WAITING;
+    std::vector<Utf8String> dependsOn;  ///< As collection/id
+    double loadingSeconds = 0.0;        ///< So far, or in total once done
+    Utf8String error;                   ///< Why it failed
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(EntityRestoreStatus);
+
+/** Where the restoration of all of the entities is at. */
+struct EntityRestorerStatus {
+    bool ready = false;   ///< Every entity is loaded or has failed
+    int numWaiting = 0;
+    int numLoading = 0;
+    int numLoaded = 0;
+    int numFailed = 0;
+    std::vector<EntityRestoreStatus> entities;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(EntityRestorerStatus);
+
+
+/*****************************************************************************/
+/* ENTITY RESTORER                                                           */
+/*****************************************************************************/
+
+/** Restores entities from their stored configuration, with up to
+    maxConcurrency of them loading at once.
+
+    An entity waits for the ones its configuration refers to (see
+    findReferences()), so that for example a function is created after the
+    dataset that it reads from.  It also waits for every entity added with
+    a lower phase, which is how plugins, which may provide the types of the
+    other entities, come first.  A failure doesn't hold up the entities
+    that depend on the one that failed; they are tried anyway, as the
+    reference may have been a false positive.  Dependencies that form a
+    cycle are broken, in the order the entities were added.
+*/
+struct EntityRestorer {
+    EntityRestorer(int maxConcurrency = 8);
+
+    /// Cancels and waits for the entities that are loading to finish
+    ~EntityRestorer();
+
+    EntityRestorer(const EntityRestorer &) = delete;
+    void operator = (const EntityRestorer &) = delete;
+
+    /** Add an entity to restore.  restore() is called on one of the
+        restorer's threads and returns once the entity is loaded, or
+        throws if it couldn't be.  Must be called before start().
+    */
+    void add(Utf8String collection, Utf8String id, Json::Value config,
+             std::function<void ()> restore, int phase = 0);
+
+    /** Work out the dependencies and start restoring in the background. */
+    void start();
+
+    /** Wait until every entity is loaded or has failed. */
+    void wait();
+
+    /** Don't start loading any more entities.  Those that are loading
+        carry on, and are waited for by the destructor.
+    */
+    void cancel();
+
+    EntityRestorerStatus getStatus() const;
+
+    /** Return those of names that config refers to: those found in one of
+        its strings, not as part of a longer identifier.  A string that
+        is a name matches, as does a name in a SQL query.
+    */
+    static std::set<Utf8String>
+    findReferences(const Json::Value & config,
+                   const std::set<Utf8String> & names);
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+} // namespace MLDB
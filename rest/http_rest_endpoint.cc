@@ -14,6 +14,10 @@
 #include "http_rest_endpoint.h"
 #include "mldb/utils/log.h"
 #include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <string_view>
+#include <strings.h>
 
 using namespace std;
 
@@ -25,6 +29,10 @@ namespace MLDB {
 
 HttpRestEndpoint::
 HttpRestEndpoint(EventLoop & eventLoop, bool enableLogging)
+    : reusePort(REUSE_PORT_NONE),
+      compressionMinBytes(-1),
+      compressionLevel(-1),
+      compressionEncodings({ "zstd", "gzip" })
 {
     auto makeHandler = [&, enableLogging] (TcpSocket && socket) {
         return make_shared<RestConnectionHandler>(this, std::move(socket), enableLogging);
@@ -44,6 +52,14 @@ allowAllOrigins()
     extraHeaders.push_back({ "Access-Control-Allow-Origin", "*" });
 }
 
+void
+HttpRestEndpoint::
+setCompression(ssize_t minBytes, int level)
+{
+    compressionMinBytes = minBytes;
+    compressionLevel = level;
+}
+
 void
 HttpRestEndpoint::
 init()
@@ -109,7 +125,7 @@ bindTcp(PortRange const & portRange, std::string host)
     if (host == "" || host == "*")
         host = "0.0.0.0";
 
-    acceptor_->listen(portRange, host);
+    acceptor_->listen(portRange, host, 128, reusePort);
     int port = acceptor_->effectiveTCPv4Port();
     const char * literate_doc_bind_file = getenv("LITERATE_DOC_BIND_FILENAME");
     if (literate_doc_bind_file) {
@@ -128,6 +144,81 @@ bindTcp(PortRange const & portRange, std::string host)
 /* HTTP REST ENDPOINT :: REST CONNECTION HANDLER                             */
 /*****************************************************************************/
 
+namespace {
+
+/** Return whether the given content coding is allowed by the value of an
+    Accept-Encoding header.  Preferences between the allowed codings are
+    ignored; a q value of zero disallows one.
+*/
+bool acceptsEncoding(const std::string & acceptEncoding,
+                     const std::string & encoding)
+{
+    auto trim = [] (std::string_view s)
+        {
+            while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+                s.remove_prefix(1);
+            while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+                s.remove_suffix(1);
+            return s;
+        };
+
+    bool wildcard = false;
+
+    for (size_t pos = 0;  pos < acceptEncoding.size();) {
+        size_t end = acceptEncoding.find(',', pos);
+        if (end == std::string::npos)
+            end = acceptEncoding.size();
+        std::string_view item(acceptEncoding.data() + pos, end - pos);
+        pos = end + 1;
+
+        bool allowed = true;
+        size_t semi = item.find(';');
+        if (semi != std::string_view::npos) {
+            size_t q = item.find("q=", semi);
+            if (q != std::string_view::npos)
+                allowed = strtod(item.data() + q + 2, nullptr) > 0;
+            item = item.substr(0, semi);
+        }
+        item = trim(item);
+
+        if (item.size() == encoding.size()
+            && strncasecmp(item.data(), encoding.data(), item.size()) == 0)
+            return allowed;
+        if (item == "*")
+            wildcard = allowed;
+    }
+
+    return wildcard;
+}
+
+/// Compression level for the given coding when none is configured
+int defaultCompressionLevel(const std::string & encoding)
+{
+    return encoding == "zstd" ? 3 : 6;
+}
+
+Compressor * createCompressor(const std::string & encoding, int level)
+{
+    Compressor * result
+        = Compressor::create(encoding,
+                             level == -1 ? defaultCompressionLevel(encoding)
+                             : level);
+    if (!result)
+        throw MLDB::Exception("no compressor for content coding " + encoding);
+    return result;
+}
+
+bool hasHeader(const RestParams & headers, const char * name)
+{
+    for (auto & h: headers) {
+        if (strcasecmp(h.first.rawData(), name) == 0)
+            return true;
+    }
+    return false;
+}
+
+} // file scope
+
 HttpRestEndpoint::RestConnectionHandler::
 RestConnectionHandler(HttpRestEndpoint * endpoint, TcpSocket && socket, bool enableLogging)
     : HttpLegacySocketHandler(std::move(socket)), endpoint(endpoint)
@@ -211,6 +302,30 @@ sendResponse(int code,
              std::string body, std::string contentType,
              RestParams headers)
 {
+    std::string encoding;
+    if (!hasHeader(headers, "Content-Encoding"))
+        encoding = getResponseEncoding(body.size());
+
+    if (!encoding.empty()) {
+        std::string compressed;
+        auto onData = [&] (const char * data, size_t len)
+            {
+                compressed.append(data, len);
+                return len;
+            };
+        std::unique_ptr<Compressor> compressor
+            (createCompressor(encoding, endpoint->compressionLevel));
+        compressor->compress(body.data(), body.size(), onData);
+        compressor->finish(onData);
+
+        // Incompressible data is sent as it is
+        if (compressed.size() < body.size()) {
+            body = std::move(compressed);
+            headers.emplace_back("Content-Encoding", encoding);
+        }
+        headers.emplace_back("Vary", "Accept-Encoding");
+    }
+
     for (auto & h: endpoint->extraHeaders)
         headers.push_back(h);
 
@@ -220,6 +335,22 @@ sendResponse(int code,
                                    std::move(headers)));
 }
 
+void
+HttpRestEndpoint::RestConnectionHandler::
+sendResponse(int code,
+             std::vector<WriteBuffer> body, std::string contentType,
+             RestParams headers)
+{
+    for (auto & h: endpoint->extraHeaders)
+        headers.push_back(h);
+
+    logRequest(code);
+    putResponseOnWire(HttpResponse(code,
+                                   std::move(contentType), std::string(),
+                                   std::move(headers)),
+                      std::move(body));
+}
+
 void
 HttpRestEndpoint::RestConnectionHandler::
 sendResponseHeader(int code, std::string contentType, RestParams headers)
@@ -229,10 +360,27 @@ sendResponseHeader(int code, std::string contentType, RestParams headers)
         // the connection isn't closed
     };
     
+    // A chunked response is compressed as it goes, whatever its size
+    chunkCompressor.reset();
+    bool chunked = false;
+    for (auto & h: headers) {
+        if (strcasecmp(h.first.rawData(), "Transfer-Encoding") == 0
+            && h.second == "chunked")
+            chunked = true;
+    }
+    if (chunked && !hasHeader(headers, "Content-Encoding")) {
+        std::string encoding = getResponseEncoding(-1);
+        if (!encoding.empty()) {
+            chunkCompressor.reset
+                (createCompressor(encoding, endpoint->compressionLevel));
+            headers.emplace_back("Content-Encoding", encoding);
+            headers.emplace_back("Vary", "Accept-Encoding");
+        }
+    }
+
     for (auto & h: endpoint->extraHeaders)
         headers.push_back(h);
 
-
     logRequest(code);
     putResponseOnWire(HttpResponse(code,
                                    std::move(contentType),
@@ -246,7 +394,90 @@ sendHttpChunk(std::string chunk,
               NextAction next,
               OnWriteFinished onWriteFinished)
 {
-    HttpLegacySocketHandler::send(std::move(chunk), next, onWriteFinished);
+    if (chunkCompressor) {
+        std::string compressed;
+        auto onData = [&] (const char * data, size_t len)
+            {
+                compressed.append(data, len);
+                return len;
+            };
+
+        if (chunk.empty()) {
+            // End of the response; the rest of the compressed stream goes
+            // before the empty chunk
+            chunkCompressor->finish(onData);
+            chunkCompressor.reset();
+            if (!compressed.empty())
+                sendFramedChunk(std::move(compressed), NEXT_CONTINUE, nullptr);
+        }
+        else {
+            // Flush each chunk, so that the client can decode what it has
+            // received without waiting for the rest
+            chunkCompressor->compress(chunk.data(), chunk.size(), onData);
+            chunkCompressor->flush(Compressor::FLUSH_SYNC, onData);
+            if (compressed.empty()) {
+                // Nothing to send yet; an empty chunk would end the payload
+                if (onWriteFinished)
+                    onWriteFinished();
+                return;
+            }
+            chunk = std::move(compressed);
+        }
+    }
+
+    sendFramedChunk(std::move(chunk), next, std::move(onWriteFinished));
+}
+
+void
+HttpRestEndpoint::RestConnectionHandler::
+sendFramedChunk(std::string chunk,
+                NextAction next,
+                OnWriteFinished onWriteFinished)
+{
+    // Frame it as a chunk of the chunked transfer encoding; the empty
+    // chunk marks the end of the payload
+    char size[32];
+    snprintf(size, sizeof(size), "%zx\r\n", chunk.size());
+
+    // Large chunks are written in place rather than copied into the frame
+    if (chunk.size() >= 16384) {
+        std::vector<WriteBuffer> buffers;
+        buffers.emplace_back(std::string(size));
+        buffers.emplace_back(std::move(chunk));
+        buffers.emplace_back(WriteBuffer::staticData("\r\n", 2));
+        HttpLegacySocketHandler::send(std::move(buffers), next,
+                                      onWriteFinished);
+        return;
+    }
+
+    std::string framed;
+    framed.reserve(chunk.size() + strlen(size) + 2);
+    framed.append(size);
+    framed.append(chunk);
+    framed.append("\r\n");
+
+    HttpLegacySocketHandler::send(std::move(framed), next, onWriteFinished);
+}
+
+std::string
+HttpRestEndpoint::RestConnectionHandler::
+getResponseEncoding(ssize_t size) const
+{
+    if (endpoint->compressionMinBytes < 0
+        || (size >= 0 && size < endpoint->compressionMinBytes))
+        return std::string();
+
+    const std::string & acceptEncoding
+        = httpHeader.tryGetHeader("accept-encoding");
+    if (acceptEncoding.empty())
+        return std::string();
+
+    for (auto & encoding: endpoint->compressionEncodings) {
+        if (acceptsEncoding(acceptEncoding, encoding))
+            return encoding;
+    }
+
+    return std::string();
 }
 
 inline void
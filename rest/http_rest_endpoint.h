@@ -8,7 +8,9 @@
 
 #include "mldb/http/http_socket_handler.h"
 #include "mldb/io/port_range_service.h"
+#include "mldb/io/tcp_acceptor.h"
 #include "mldb/utils/log_fwd.h"
+#include "mldb/vfs/compressor.h"
 #include <atomic>
 #include <memory>
 #include <string>
@@ -19,7 +21,6 @@ namespace MLDB {
 /* Forward declarations */
 struct EventLoop;
 struct HttpHeader;
-struct TcpAcceptor;
 
 
 /*****************************************************************************/
@@ -35,6 +36,14 @@ struct HttpRestEndpoint {
     /** Set the Access-Control-Allow-Origin: * HTTP header */
     void allowAllOrigins();
 
+    /** Compress the bodies of responses of at least minBytes bytes, as
+        well as chunked responses, with the first of compressionEncodings
+        that the Accept-Encoding header of the request allows.  A level of
+        -1 uses a default for each encoding that favours speed.  A minBytes
+        of -1 turns compression off, which is the default.
+    */
+    void setCompression(ssize_t minBytes, int level = -1);
+
     void init();
     void shutdown();
     void closePeer();
@@ -91,6 +100,18 @@ struct HttpRestEndpoint {
                           std::string body, std::string contentType,
                           RestParams headers = RestParams());
 
+        /** Send a response whose body is made of the given buffers, which
+            are written out as they are without being joined.  The owner
+            of each buffer is kept alive until the write completes, so a
+            frozen memory region can be sent directly with
+            WriteBuffer(region.data(), region.length(),
+                        std::make_shared<FrozenMemoryRegion>(std::move(region))).
+        */
+        void sendResponse(int code,
+                          std::vector<WriteBuffer> body,
+                          std::string contentType,
+                          RestParams headers = RestParams());
+
         void sendResponseHeader(int code,
                                 std::string contentType,
                                 RestParams headers = RestParams());
@@ -103,9 +124,23 @@ struct HttpRestEndpoint {
 
     private:
         void logRequest(int code) const;
+
+        /** Return the content coding to compress a response of the given
+            size with (-1 for a chunked response), or the empty string if
+            it shouldn't be compressed.
+        */
+        std::string getResponseEncoding(ssize_t size) const;
+
+        /// Frame and send a chunk of the chunked transfer encoding
+        void sendFramedChunk(std::string chunk, NextAction next,
+                             OnWriteFinished onWriteFinished);
+
         HttpHeader httpHeader;
         std::shared_ptr<spdlog::logger> logger;
         timespec timer;
+
+        /// Compresses the chunks of the response being sent, if any
+        std::unique_ptr<Compressor> chunkCompressor;
     };
 
     typedef std::function<void (std::shared_ptr<RestConnectionHandler> connection,
@@ -116,6 +151,19 @@ struct HttpRestEndpoint {
 
     std::vector<std::pair<std::string, std::string> > extraHeaders;
 
+    /// Whether the listening socket shares its port with other endpoints
+    ReusePort reusePort;
+
+    /// Minimum response size to compress; -1 means never.  See
+    /// setCompression().
+    ssize_t compressionMinBytes;
+
+    /// Compression level, or -1 for the default of each encoding
+    int compressionLevel;
+
+    /// HTTP content codings that we compress with, in order of preference
+    std::vector<std::string> compressionEncodings;
+
     std::unique_ptr<TcpAcceptor> acceptor_;
 };
 
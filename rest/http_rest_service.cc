@@ -12,9 +12,16 @@
 #include "mldb/ext/cityhash/src/city.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/io/event_loop.h"
+#include "mldb/io/event_loop_impl.h"
 #include "http_rest_endpoint.h"
 #include "http_rest_service.h"
 #include "mldb/utils/log.h"
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <pthread.h>
 
 using namespace std;
 
@@ -177,17 +184,68 @@ isConnected()
     return http->isConnected();
 }
 
+struct HttpRestConnection::PendingPayload {
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t bytes = 0;
+
+    void add(size_t n)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        bytes += n;
+    }
+
+    void written(size_t n)
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            bytes -= n;
+        }
+        cv.notify_all();
+    }
+};
+
 void
 HttpRestConnection::
 sendPayload(std::string payload)
 {
+    if (!pending)
+        pending = std::make_shared<PendingPayload>();
+
+    size_t length = payload.length();
+    pending->add(length);
+    auto onWritten = [pending = this->pending, length] ()
+        {
+            pending->written(length);
+        };
+
     if (chunkedEncoding) {
         if (payload.empty()) {
             throw MLDB::Exception("Can't send empty chunk over a chunked connection");
         }
-        http->sendHttpChunk(std::move(payload), HttpLegacySocketHandler::NEXT_CONTINUE);
+        http->sendHttpChunk(std::move(payload), HttpLegacySocketHandler::NEXT_CONTINUE,
+                            onWritten);
     }
-    else http->send(std::move(payload));
+    else http->send(std::move(payload), HttpLegacySocketHandler::NEXT_CONTINUE,
+                    onWritten);
+}
+
+bool
+HttpRestConnection::
+waitForPendingPayload(size_t maxBytes)
+{
+    if (!pending)
+        return isConnected();
+
+    std::unique_lock<std::mutex> guard(pending->mutex);
+    while (pending->bytes > maxBytes) {
+        // Wake up from time to time, as a closed connection may never
+        // finish its writes
+        pending->cv.wait_for(guard, std::chrono::milliseconds(100));
+        if (!isConnected())
+            return false;
+    }
+    return isConnected();
 }
 
 void
@@ -234,12 +292,27 @@ captureInConnection(std::shared_ptr<void> toCapture)
 /* HTTP REST SERVICE                                                         */
 /*****************************************************************************/
 
+/** One of the event loops of the multi-reactor mode, with the thread
+    that runs it and the endpoint whose connections it handles.
+*/
+struct HttpRestService::Reactor {
+    Reactor(bool enableLogging)
+        : endpoint(loop, enableLogging)
+    {
+    }
+
+    EventLoop loop;
+    HttpRestEndpoint endpoint;
+    std::thread thread;
+};
+
 HttpRestService::
 HttpRestService(bool enableLogging)
     : eventLoop(new EventLoop()),
       threadPool(new AsioThreadPool(*eventLoop)),
       httpEndpoint(new HttpRestEndpoint(*eventLoop, enableLogging)),
-      logger(MLDB::getMldbLog<HttpRestService>())
+      logger(MLDB::getMldbLog<HttpRestService>()),
+      enableLogging(enableLogging)
 {
 }
 
@@ -253,9 +326,20 @@ void
 HttpRestService::
 shutdown()
 {
-    // 1.  Shut down the http endpoint, since it needs our threads to
-    //     complete its shutdown
+    // 1.  Shut down the http endpoints, since they need our threads to
+    //     complete their shutdown
     httpEndpoint->shutdown();
+    for (auto & r: reactors) {
+        r->endpoint.shutdown();
+    }
+
+    // 2.  Stop the reactors
+    for (auto & r: reactors) {
+        if (!r->thread.joinable())
+            continue;
+        r->loop.impl().ioService().stop();
+        r->thread.join();
+    }
 
     threadPool->shutdown();
 }
@@ -276,13 +360,141 @@ init()
             this->doHandleRequest(restConnection,
                                   RestRequest(header, payload));
         };
+
+    for (auto & r: reactors) {
+        r->endpoint.onRequest = httpEndpoint->onRequest;
+    }
+}
+
+void
+HttpRestService::
+setReactors(int numReactors, bool pinThreads)
+{
+    ExcAssert(reactors.empty());
+    if (numReactors < 0)
+        throw MLDB::Exception("number of HTTP reactors can't be negative");
+
+    int numCores = std::max<int>(1, std::thread::hardware_concurrency());
+
+    for (int i = 0;  i < numReactors;  ++i) {
+        std::unique_ptr<Reactor> reactor(new Reactor(enableLogging));
+        reactor->endpoint.init();
+        reactor->endpoint.onRequest = httpEndpoint->onRequest;
+        reactor->endpoint.extraHeaders = httpEndpoint->extraHeaders;
+        reactor->endpoint.setCompression(httpEndpoint->compressionMinBytes,
+                                         httpEndpoint->compressionLevel);
+        reactor->endpoint.reusePort
+            = i == 0 ? REUSE_PORT_NEW : REUSE_PORT_JOIN;
+
+        Reactor * r = reactor.get();
+        int core = i % numCores;
+        auto run = [r, core, pinThreads] ()
+            {
+                if (pinThreads) {
+                    cpu_set_t cpus;
+                    CPU_ZERO(&cpus);
+                    CPU_SET(core, &cpus);
+                    int res = pthread_setaffinity_np(pthread_self(),
+                                                     sizeof(cpus), &cpus);
+                    if (res != 0) {
+                        cerr << "couldn't pin HTTP reactor to core " << core
+                             << ": " << strerror(res) << endl;
+                    }
+                }
+                r->loop.run();
+            };
+        reactor->thread = std::thread(run);
+
+        reactors.emplace_back(std::move(reactor));
+    }
+}
+
+void
+HttpRestService::
+allowAllOrigins()
+{
+    httpEndpoint->allowAllOrigins();
+    for (auto & r: reactors) {
+        r->endpoint.allowAllOrigins();
+    }
+}
+
+void
+HttpRestService::
+setCompression(ssize_t minBytes, int level)
+{
+    httpEndpoint->setCompression(minBytes, level);
+    for (auto & r: reactors) {
+        r->endpoint.setCompression(minBytes, level);
+    }
+}
+
+void
+HttpRestService::
+doHandleRequest(HttpRestConnection & connection,
+                const RestRequest & request)
+{
+    if (logRequest)
+        logRequest(connection, request);
+
+    // Held until the request has been handled, to keep its place
+    std::shared_ptr<void> ticket;
+    auto outcome = admission.admit(request, ticket);
+    if (outcome != AdmissionControl::ADMITTED) {
+        Json::Value error;
+        error["error"] = outcome == AdmissionControl::QUEUE_FULL
+            ? "Too many requests are waiting for this route"
+            : "Request waited too long for this route";
+        error["httpCode"] = 503;
+        connection.sendHttpResponse(503, error.toStringNoNewLine(),
+                                    "application/json",
+                                    { { "Retry-After", "1" } });
+        return;
+    }
+
+    handleRequest(connection, request);
+}
+
+void
+HttpRestService::
+closeEndpoints()
+{
+    httpEndpoint->closePeer();
+    for (auto & r: reactors) {
+        r->endpoint.closePeer();
+    }
+}
+
+std::string
+HttpRestService::
+bindReactors(const std::function<std::string (HttpRestEndpoint &)> & bind)
+{
+    std::string httpAddr = bind(reactors[0]->endpoint);
+
+    // The others listen on the same port, wherever the first one ended up
+    int port = reactors[0]->endpoint.acceptor_->effectiveTCPv4Port();
+    std::string host(httpAddr, 7 /* http:// */, httpAddr.rfind(':') - 7);
+    for (size_t i = 1;  i < reactors.size();  ++i) {
+        reactors[i]->endpoint.bindTcpFixed(host, port);
+    }
+
+    return httpAddr;
 }
 
 std::string
 HttpRestService::
 bindTcp(PortRange const & httpRange, std::string host)
 {
-    std::string httpAddr = httpEndpoint->bindTcp(httpRange, host);
+    std::string httpAddr;
+    if (reactors.empty()) {
+        httpAddr = httpEndpoint->bindTcp(httpRange, host);
+    }
+    else {
+        httpAddr = bindReactors([&] (HttpRestEndpoint & endpoint)
+                                {
+                                    return endpoint.bindTcp(httpRange, host);
+                                });
+    }
     DEBUG_MSG(logger) << "http listening on " << httpAddr;
     return httpAddr;
 }
@@ -291,14 +503,24 @@ std::string
 HttpRestService::
 bindFixedHttpAddress(std::string host, int port)
 {
-    return httpEndpoint->bindTcpFixed(host, port);
+    if (reactors.empty())
+        return httpEndpoint->bindTcpFixed(host, port);
+    return bindReactors([&] (HttpRestEndpoint & endpoint)
+                        {
+                            return endpoint.bindTcpFixed(host, port);
+                        });
 }
 
 std::string
 HttpRestService::
 bindFixedHttpAddress(std::string address)
 {
-    return httpEndpoint->bindTcpAddress(address);
+    if (reactors.empty())
+        return httpEndpoint->bindTcpAddress(address);
+    return bindReactors([&] (HttpRestEndpoint & endpoint)
+                        {
+                            return endpoint.bindTcpAddress(address);
+                        });
 }
 
 void
@@ -13,6 +13,7 @@
 
 #include "mldb/io/asio_thread_pool.h"
 #include "mldb/rest/http_rest_endpoint.h"
+#include "mldb/rest/admission_control.h"
 #include "mldb/io/port_range_service.h"
 #include "mldb/rest/rest_connection.h"
 #include "mldb/rest/rest_request.h"
@@ -68,6 +69,12 @@ struct HttpRestConnection: public RestConnection {
     */
     std::vector<std::shared_ptr<void> > piggyBack;
 
+    /** Payload that has been sent but not yet written.  It's shared with
+        the write callbacks, which may run after the connection is moved.
+    */
+    struct PendingPayload;
+    std::shared_ptr<PendingPayload> pending;
+
     using RestConnection::sendResponse;
 
     /** Send the given response back on the connection. */
@@ -105,6 +112,8 @@ struct HttpRestConnection: public RestConnection {
     /** Finish the response, recycling or closing the connection. */
     virtual void finishResponse();
 
+    virtual bool waitForPendingPayload(size_t maxBytes);
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
@@ -153,6 +162,39 @@ struct HttpRestService {
 
     void init();
 
+    /** Serve HTTP from numReactors independent event loops instead of the
+        shared event loop and its thread pool.  Each reactor has its own
+        thread, listening socket and connections; the listening sockets
+        share the port through SO_REUSEPORT, so the kernel spreads the
+        connections over them, and each request is handled on the thread
+        of the reactor that accepted it.  If pinThreads is true, reactor i
+        is pinned to core i modulo the number of cores.
+
+        This avoids handing requests from one thread to another, which
+        helps with many small requests.  A request that takes a long time
+        holds up the other connections of its reactor, however.
+
+        Must be called before binding.  Zero (the default) means no
+        reactors.
+    */
+    void setReactors(int numReactors, bool pinThreads = true);
+
+    /// Number of reactors set up by setReactors()
+    int numReactors() const { return reactors.size(); }
+
+    /** Set the Access-Control-Allow-Origin: * HTTP header on all of the
+        endpoints.
+    */
+    void allowAllOrigins();
+
+    /** Compress responses on all of the endpoints; see
+        HttpRestEndpoint::setCompression().
+    */
+    void setCompression(ssize_t minBytes, int level = -1);
+
+    /** Stop accepting new connections on all of the endpoints. */
+    void closeEndpoints();
+
     /** Bind to TCP/IP port */
     std::string bindTcp(PortRange const & httpRange = PortRange(),
                         std::string host = "");
@@ -183,14 +225,17 @@ struct HttpRestService {
                         const std::string & resp,
                         const std::string & contentType) > logResponse;
 
+    /** Handle a request received over HTTP: log it, and pass it to
+        handleRequest() once admission control lets it through, or reject
+        it with a 503 if it doesn't.
+    */
     void doHandleRequest(HttpRestConnection & connection,
-                         const RestRequest & request)
-    {
-        if (logRequest)
-            logRequest(connection, request);
+                         const RestRequest & request);
 
-        handleRequest(connection, request);
-    }
+    /** Limits on the number of concurrent requests to routes of the
+        service.  There are none by default.
+    */
+    AdmissionControl admission;
     
     // Create a random request ID for an HTTP request
     std::string getHttpRequestId() const;
@@ -204,6 +249,18 @@ struct HttpRestService {
     std::unique_ptr<AsioThreadPool> threadPool;
     std::unique_ptr<HttpRestEndpoint> httpEndpoint;
     std::shared_ptr<spdlog::logger> logger;
+
+private:
+    bool enableLogging;
+
+    /** Bind the first reactor with the given function, which returns its
+        uri, and then the others to the same port.
+    */
+    std::string
+    bindReactors(const std::function<std::string (HttpRestEndpoint &)> & bind);
+
+    struct Reactor;
+    std::vector<std::unique_ptr<Reactor> > reactors;
 };
 
 } // namespace MLDB
@@ -0,0 +1,272 @@
+/** latency_metrics.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Always-on latency histograms, exported in the Prometheus text format.
+*/
+
+#include "latency_metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* LATENCY HISTOGRAM                                                         */
+/*****************************************************************************/
+
+int
+LatencyHistogram::
+getBucket(uint64_t micros)
+{
+    if (micros < SUB_BUCKETS)
+        return micros;
+    int bits = 63 - __builtin_clzll(micros);
+    if (bits >= MAX_BITS)
+        return NUM_BUCKETS - 1;
+    int shift = bits - SUB_BUCKET_BITS;
+    return ((shift + 1) << SUB_BUCKET_BITS)
+        + ((micros >> shift) & (SUB_BUCKETS - 1));
+}
+
+uint64_t
+LatencyHistogram::
+getBucketLowerBound(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    int shift = (bucket >> SUB_BUCKET_BITS) - 1;
+    return (uint64_t)(SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+}
+
+uint64_t
+LatencyHistogram::
+getBucketUpperBound(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket + 1;
+    int shift = (bucket >> SUB_BUCKET_BITS) - 1;
+    return getBucketLowerBound(bucket) + ((uint64_t)1 << shift);
+}
+
+int
+LatencyHistogram::
+getShard()
+{
+    static std::atomic<unsigned> nextShard(0);
+    static thread_local int shard = nextShard++ % NUM_SHARDS;
+    return shard;
+}
+
+LatencyHistogram::Snapshot
+LatencyHistogram::
+snapshot() const
+{
+    Snapshot result;
+    result.counts.resize(NUM_BUCKETS);
+    for (auto & shard: shards) {
+        for (int i = 0;  i < NUM_BUCKETS;  ++i) {
+            uint64_t n = shard.counts[i].load(std::memory_order_relaxed);
+            result.counts[i] += n;
+            result.count += n;
+        }
+        result.sumMicros += shard.sumMicros.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+double
+LatencyHistogram::Snapshot::
+quantile(double q) const
+{
+    if (count == 0)
+        return 0.0;
+    uint64_t rank = std::max<uint64_t>(1, std::min<double>(q, 1.0) * count);
+    uint64_t seen = 0;
+    for (int i = 0;  i < NUM_BUCKETS;  ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return 0.5e-6 * (getBucketLowerBound(i) + getBucketUpperBound(i));
+        }
+    }
+    return 1e-6 * getBucketUpperBound(NUM_BUCKETS - 1);
+}
+
+
+/*****************************************************************************/
+/* LATENCY METRIC                                                            */
+/*****************************************************************************/
+
+namespace {
+
+/// Every metric that exists, to be exported
+struct MetricRegistry {
+    std::mutex mutex;
+    std::set<LatencyMetric *> metrics;
+};
+
+// Never destroyed, so that static metrics can unregister in any order
+MetricRegistry & getRegistry()
+{
+    static MetricRegistry * registry = new MetricRegistry();
+    return *registry;
+}
+
+/// Turn label values into the form that Prometheus expects inside {}
+std::string formatLabels(const LatencyMetric::Labels & labels)
+{
+    std::string result;
+    for (auto & l: labels) {
+        if (!result.empty())
+            result += ',';
+        result += l.first;
+        result += "=\"";
+        for (char c: l.second) {
+            switch (c) {
+            case '\\': result += "\\\\";  break;
+            case '"':  result += "\\\"";  break;
+            case '\n': result += "\\n";   break;
+            default:   result += c;
+            }
+        }
+        result += '"';
+    }
+    return result;
+}
+
+std::string formatSeconds(double seconds)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9g", seconds);
+    return buf;
+}
+
+/// Bucket boundaries, in seconds, that are exported to Prometheus
+const double EXPORTED_BUCKETS[] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+    0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300, 1800
+};
+
+std::atomic<uint64_t> nextMetricId(1);
+
+} // file scope
+
+struct LatencyMetric::Itl {
+    /// Distinguishes this metric in the per-thread caches, even once
+    /// another one has been allocated at the same address
+    uint64_t id = nextMetricId++;
+
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<LatencyHistogram> > histograms;
+};
+
+LatencyMetric::
+LatencyMetric(std::string name, std::string help)
+    : name(std::move(name)), help(std::move(help)), itl(new Itl())
+{
+    auto & registry = getRegistry();
+    std::unique_lock<std::mutex> guard(registry.mutex);
+    registry.metrics.insert(this);
+}
+
+LatencyMetric::
+~LatencyMetric()
+{
+    auto & registry = getRegistry();
+    std::unique_lock<std::mutex> guard(registry.mutex);
+    registry.metrics.erase(this);
+}
+
+LatencyHistogram &
+LatencyMetric::
+get(const Labels & labels)
+{
+    std::string key = formatLabels(labels);
+
+    // Histograms are never removed from a metric, so each thread can keep
+    // the ones that it has used without taking the lock
+    static thread_local std::unordered_map<std::string, LatencyHistogram *>
+        cache;
+
+    std::string cacheKey = std::to_string(itl->id);
+    cacheKey += '|';
+    cacheKey += key;
+
+    auto it = cache.find(cacheKey);
+    if (it != cache.end())
+        return *it->second;
+
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    auto & entry = itl->histograms[key];
+    if (!entry)
+        entry.reset(new LatencyHistogram());
+    cache[cacheKey] = entry.get();
+    return *entry;
+}
+
+const char * const LATENCY_METRICS_CONTENT_TYPE
+    = "text/plain; version=0.0.4";
+
+std::string getLatencyMetricsText()
+{
+    auto & registry = getRegistry();
+    std::unique_lock<std::mutex> registryGuard(registry.mutex);
+
+    std::vector<LatencyMetric *> metrics(registry.metrics.begin(),
+                                         registry.metrics.end());
+    std::sort(metrics.begin(), metrics.end(),
+              [] (LatencyMetric * m1, LatencyMetric * m2)
+              {
+                  return m1->getName() < m2->getName();
+              });
+
+    std::string result;
+
+    for (LatencyMetric * metric: metrics) {
+        const std::string & name = metric->name;
+        result += "# HELP " + name + " " + metric->help + "\n";
+        result += "# TYPE " + name + " histogram\n";
+
+        std::unique_lock<std::mutex> guard(metric->itl->mutex);
+        for (auto & h: metric->itl->histograms) {
+            const std::string & labels = h.first;
+            std::string prefix = labels.empty() ? "{" : "{" + labels + ",";
+            auto snapshot = h.second->snapshot();
+
+            // A bucket is counted under a boundary only if all of it is
+            // below, so the exported counts are exact lower bounds
+            int bucket = 0;
+            uint64_t cumulative = 0;
+            for (double le: EXPORTED_BUCKETS) {
+                uint64_t limit = le * 1000000;
+                while (bucket < LatencyHistogram::NUM_BUCKETS
+                       && LatencyHistogram::getBucketUpperBound(bucket)
+                          <= limit + 1)
+                    cumulative += snapshot.counts[bucket++];
+                result += name + "_bucket" + prefix + "le=\""
+                    + formatSeconds(le) + "\"} "
+                    + std::to_string(cumulative) + "\n";
+            }
+            result += name + "_bucket" + prefix + "le=\"+Inf\"} "
+                + std::to_string(snapshot.count) + "\n";
+
+            std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+            result += name + "_sum" + suffix + " "
+                + formatSeconds(snapshot.sumMicros * 1e-6) + "\n";
+            result += name + "_count" + suffix + " "
+                + std::to_string(snapshot.count) + "\n";
+        }
+    }
+
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,172 @@
+/** latency_metrics.h                                              -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Always-on latency histograms, exported in the Prometheus text format.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstdint>
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* LATENCY HISTOGRAM                                                         */
+/*****************************************************************************/
+
+/** Histogram of durations, with buckets whose width is a fixed fraction of
+    their value (like HdrHistogram) so that it covers microseconds to days
+    to within 12.5% in a few hundred counters.
+
+    Recording is lock-free: each thread counts into one of several shards,
+    so that threads on different cores don't fight over the same cache
+    lines.  The shards are only added up when the histogram is read.
+*/
+
+struct LatencyHistogram {
+    /// Each power of two is split into 2^SUB_BUCKET_BITS buckets
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+    /// Durations are counted in microseconds, up to 2^MAX_BITS (12 days)
+    static constexpr int MAX_BITS = 40;
+    static constexpr int NUM_BUCKETS
+        = (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    static constexpr int NUM_SHARDS = 8;
+
+    /// Record a duration, in microseconds
+    void record(uint64_t micros)
+    {
+        Shard & shard = shards[getShard()];
+        shard.counts[getBucket(micros)].fetch_add(1, std::memory_order_relaxed);
+        shard.sumMicros.fetch_add(micros, std::memory_order_relaxed);
+    }
+
+    /// Record a duration, in seconds
+    void recordSeconds(double seconds)
+    {
+        record(seconds <= 0 ? 0 : (uint64_t)(seconds * 1000000.0 + 0.5));
+    }
+
+    /// Return the bucket in which the given number of microseconds falls
+    static int getBucket(uint64_t micros);
+
+    /// Return the smallest number of microseconds in the given bucket
+    static uint64_t getBucketLowerBound(int bucket);
+
+    /// Return the smallest number of microseconds above the given bucket
+    static uint64_t getBucketUpperBound(int bucket);
+
+    /// Totals over all of the shards, at one point in time
+    struct Snapshot {
+        std::vector<uint64_t> counts;   ///< Count in each bucket
+        uint64_t count = 0;             ///< Total number of durations
+        uint64_t sumMicros = 0;         ///< Total of the durations
+
+        /** Return an estimate of the given quantile (between 0 and 1), in
+            seconds, or zero if nothing was recorded.
+        */
+        double quantile(double q) const;
+    };
+
+    Snapshot snapshot() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counts[NUM_BUCKETS] = {};
+        std::atomic<uint64_t> sumMicros = { 0 };
+    };
+
+    Shard shards[NUM_SHARDS];
+
+    static int getShard();
+};
+
+
+/*****************************************************************************/
+/* LATENCY METRIC                                                            */
+/*****************************************************************************/
+
+/** A named family of latency histograms, one for each set of label values,
+    like a Prometheus histogram metric.  Metrics are normally static objects
+    next to the code that they time; they register themselves so that
+    getLatencyMetricsText() can find them.
+*/
+
+struct LatencyMetric {
+    typedef std::vector<std::pair<std::string, std::string> > Labels;
+
+    /** Create the metric with the given name, which must be a valid
+        Prometheus metric name, and help text.
+    */
+    LatencyMetric(std::string name, std::string help);
+
+    ~LatencyMetric();
+
+    /** Return the histogram for the given label values, creating it the
+        first time.  The histogram lives as long as the metric.  This takes
+        no lock once the calling thread has seen the same labels before.
+    */
+    LatencyHistogram & get(const Labels & labels);
+
+    /// Record a duration in seconds against the given labels
+    void recordSeconds(const Labels & labels, double seconds)
+    {
+        get(labels).recordSeconds(seconds);
+    }
+
+    const std::string & getName() const { return name; }
+
+private:
+    friend std::string getLatencyMetricsText();
+    struct Itl;
+    std::string name;
+    std::string help;
+    std::unique_ptr<Itl> itl;
+};
+
+
+/*****************************************************************************/
+/* LATENCY TIMER                                                             */
+/*****************************************************************************/
+
+/** Records the time between its construction and its destruction into a
+    histogram.  Durations of operations that throw are recorded too.
+*/
+
+struct LatencyTimer {
+    LatencyTimer(LatencyHistogram & histogram)
+        : histogram(histogram), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~LatencyTimer()
+    {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        histogram.record(std::chrono::duration_cast<std::chrono::microseconds>
+                         (elapsed).count());
+    }
+
+private:
+    LatencyHistogram & histogram;
+    std::chrono::steady_clock::time_point start;
+};
+
+
+/** Return every histogram of every metric in the Prometheus text exposition
+    format (version 0.0.4), with the buckets in seconds.
+*/
+std::string getLatencyMetricsText();
+
+/// Content type of getLatencyMetricsText()
+extern const char * const LATENCY_METRICS_CONTENT_TYPE;
+
+} // namespace MLDB
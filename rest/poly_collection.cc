@@ -31,7 +31,9 @@ bool operator==(const PolyConfig & lhs, const PolyConfig & rhs)
         lhs.type == rhs.type &&
         lhs.persistent == rhs.persistent &&
         lhs.params == rhs.params &&
-        lhs.deterministic == rhs.deterministic;
+        lhs.deterministic == rhs.deterministic &&
+        lhs.lazy == rhs.lazy &&
+        lhs.cacheSize == rhs.cacheSize;
 }
 
 DEFINE_STRUCTURE_DESCRIPTION(PolyConfig);
@@ -54,6 +56,9 @@ PolyConfigDescription()
              "and will be reloaded on startup", false);
     addField("deterministic", &PolyConfig::deterministic,
              "If true, the entity has no hidden state ", true);
+    addField("lazy", &PolyConfig::lazy,
+             "If true, then when this element is reloaded on startup it is "
+             "only created the first time it is used", false);
 }
 
 
@@ -198,6 +203,13 @@ objectIsPersistent(const Utf8String & key, const PolyConfig & config) const
     return config.persistent;
 }
 
+bool
+PolyCollectionBase::
+objectIsLazy(const Utf8String & key, const PolyConfig & config) const
+{
+    return config.lazy || lazyByDefault;
+}
+
 DEFINE_REST_COLLECTION_INSTANTIATIONS(Utf8String, PolyEntity, PolyConfig, PolyStatus);
 
 template class WatchT<PolyCollectionBase::ChildEvent>;
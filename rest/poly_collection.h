@@ -49,6 +49,9 @@ struct PolyCollectionBase
     virtual bool
     objectIsPersistent(const Utf8String & key, const PolyConfig & config) const;
 
+    virtual bool
+    objectIsLazy(const Utf8String & key, const PolyConfig & config) const;
+
     virtual PolyStatus
     getStatusLoading(Utf8String key, const BackgroundTask & task) const;
 
@@ -75,7 +75,9 @@ struct RestDirectory;
 struct PolyConfig {
     PolyConfig()
         : persistent(false),
-          deterministic(true)
+          deterministic(true),
+          lazy(false),
+          cacheSize(-1)
     {
     }
 
@@ -83,6 +85,8 @@ struct PolyConfig {
     Utf8String type;      ///< Type of the entity.
     bool persistent;      ///< Save this object's configuration for loading
     bool deterministic;   ///< The entity has no hidden state
+    bool lazy;            ///< When restored, only create it on first use
+    int64_t cacheSize;    ///< Functions: outputs to memoize, -1 for default
     Any params;           ///< Creation parameters, per type
 };
 
@@ -15,6 +15,8 @@ LIBREST_SOURCES := \
 	rest_service_endpoint.cc \
 	http_rest_endpoint.cc \
 	http_rest_service.cc \
+	admission_control.cc \
+	latency_metrics.cc \
 	cancellation_exception.cc \
 
 LIBLINK_SOURCES := \
@@ -25,6 +27,7 @@ LIBLINK_SOURCES := \
 LIBREST_ENTITY_SOURCES := \
 	rest_entity.cc \
 	rest_collection.cc \
+	entity_restorer.cc \
 	collection_config_store.cc \
 	poly_collection.cc \
 
@@ -43,7 +46,7 @@ LIBSERVICE_PEER_SOURCES := \
 	event_service.cc
 
 
-$(eval $(call library,rest,$(LIBREST_SOURCES),arch types utils log))
+$(eval $(call library,rest,$(LIBREST_SOURCES),arch types utils log vfs))
 $(eval $(call library,link,$(LIBLINK_SOURCES),watch))
 $(eval $(call library,rest_entity,$(LIBREST_ENTITY_SOURCES),gc link any json_diff))
 $(eval $(call library,service_peer,$(LIBSERVICE_PEER_SOURCES),rest gc link rest_entity))
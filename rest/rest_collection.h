@@ -17,6 +17,7 @@
 #include "link.h"
 #include <map>
 #include <atomic>
+#include <mutex>
 
 
 namespace MLDB {
@@ -34,6 +35,7 @@ template<typename Key, class Value>
 struct RestCollection;
 
 struct CollectionConfigStore;
+struct EntityRestorer;
 
 /*****************************************************************************/
 /* REST COLLECTION BASE                                                      */
@@ -45,7 +47,8 @@ struct RestCollectionBase : public RestEntity {
                        RestEntity * parent)
         : nounSingular(nounSingular),
           nounPlural(nounPlural),
-          parent(parent)
+          parent(parent),
+          generation_(0)
     {
     }
 
@@ -76,8 +79,28 @@ struct RestCollectionBase : public RestEntity {
         return parent;
     }
 
+    /** Return the generation of the collection, which is incremented each
+        time that an entry is added, replaced or removed.  Anything that
+        is derived from the entries of the collection can record it to
+        know when it needs to be recalculated.
+    */
+    uint64_t getGeneration() const
+    {
+        return generation_.load(std::memory_order_acquire);
+    }
+
     /// Parent entity for the collection
     RestEntity * parent;
+
+protected:
+    /// Record that the entries of the collection have changed
+    void bumpGeneration()
+    {
+        generation_.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+private:
+    std::atomic<uint64_t> generation_;
 };
 
 
@@ -446,6 +469,18 @@ protected:
     void throwEntryDoesntExist(const Key & key) const MLDB_NORETURN;
     void throwEntryNotObtained(const Key & key) const MLDB_NORETURN;
     void throwEntryNotOverwritten(const Key & key) const MLDB_NORETURN;
+
+    /** Called when a key that isn't in the collection is looked up, so
+        that it can be created on demand.  Returns true if it may have
+        been added, in which case the lookup is tried again.  Default
+        returns false.
+    */
+    virtual bool loadOnDemand(const Key & key) const;
+
+    /** Called each time an existing entry is looked up.  Default does
+        nothing.
+    */
+    virtual void noteUse(const Key & key) const;
 };
 
 
@@ -487,15 +522,46 @@ struct RestConfigurableCollection: public RestCollection<Key, Value> {
     virtual void attachConfig(std::shared_ptr<CollectionConfigStore> configStore);
 
     /** Load up any existing entities, getting them and their configuration from
-        the store configured via attachConfig.
+        the store configured via attachConfig.  Returns once they have all
+        been loaded or have failed.
     */
     virtual void loadConfig();
 
+    /** Add the entities in the store configured via attachConfig to the
+        restorer, which will load them with the entities of other
+        collections in the order of their dependencies.
+    */
+    virtual void addToRestorer(EntityRestorer & restorer, int phase = 0);
+
     /** Return whether this object has required persistence.  Default
         implementation returns true.
     */
     virtual bool objectIsPersistent(const Key & key, const Config & config) const;
 
+    /** Return whether this object, when restored from the config store, is
+        only created once it is first looked up.  Default implementation
+        returns lazyByDefault.
+    */
+    virtual bool objectIsLazy(const Key & key, const Config & config) const;
+
+    /** Add an entity that will be created the first time it is looked up
+        (see loadOnDemand()), rather than now.
+    */
+    void addLazy(Key key, Config config);
+
+    /** Remove the entities that were created on demand and that haven't
+        been looked up for idleSeconds, so that they are created again when
+        they are next used.  Those that are still referenced elsewhere are
+        kept.  Returns the number removed.
+    */
+    size_t unloadIdle(double idleSeconds);
+
+    /** Number of entities added with addLazy() that are currently created. */
+    size_t numLazyLoaded() const;
+
+    /** Includes the entities that haven't been created yet. */
+    virtual std::vector<Key> getKeys() const;
+
     virtual RestRequestMatchResult
     handleGetValue(Key key,
                    RestConnection & connection,
@@ -658,8 +724,30 @@ struct RestConfigurableCollection: public RestCollection<Key, Value> {
 
     std::shared_ptr<CollectionConfigStore> configStore;
 
+    /// Restore every entity lazily; see objectIsLazy()
+    bool lazyByDefault;
+
 protected:
     bool backgroundCreate;
+
+    /// An entity that is only created the first time it is used
+    struct LazyEntry {
+        Config config;
+        std::mutex loadMutex;                  ///< Held while loading
+        std::atomic<bool> loaded{false};
+        std::atomic<double> lastUsed{0.0};     ///< Seconds since the epoch
+    };
+
+    mutable std::mutex lazyMutex;
+    std::map<Key, std::shared_ptr<LazyEntry> > lazyEntries;
+    std::atomic<size_t> numLazy;   ///< Size of lazyEntries, read unlocked
+
+    std::shared_ptr<LazyEntry> getLazyEntry(const Key & key) const;
+    void removeLazy(const Key & key);
+
+    virtual bool loadOnDemand(const Key & key) const;
+    virtual void noteUse(const Key & key) const;
+
     /* return true if the object is being created in a background thread */
     bool handlePutItl(Key key, Config config, const OnDone & onDone, bool mustBeNew);
 };
@@ -8,11 +8,14 @@
 #pragma once
 
 #include "mldb/types/value_description.h"
+#include "mldb/types/date.h"
 #include "rest_collection.h"
 #include "mldb/watch/watch_impl.h"
 #include "mldb/arch/rcu_protected.h"
 #include <future>
+#include <algorithm>
 #include "collection_config_store.h"
+#include "entity_restorer.h"
 #include "mldb/types/utility_descriptions.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/types/tuple_description.h"
@@ -68,7 +71,9 @@ struct RestCollection<Key, Value>::Impl {
     {
     }
 
-    mutable GcLock entriesLock;
+    /// Taken shared on every lookup by every thread, so its reader counts
+    /// are sharded to avoid contention
+    mutable ShardedGcLock entriesLock;
     RcuProtected<Entries> entries;
 
     /// Watches on the children
@@ -152,6 +157,7 @@ clear()
 
     auto cleanup = impl->entries.replaceCustomCleanup(new Entries());
     impl->entriesLock.visibleBarrier();
+    this->bumpGeneration();
 
     // TODO CONCURRENCY: all of these watches should complete before we
     // make any other notifications, to avoid events from other events
@@ -720,6 +726,7 @@ addEntryItl(Key key,
         std::atomic_thread_fence(std::memory_order_release);
 
         if (impl->entries.cmp_xchg(oldEntries, newEntries, true)) {
+            this->bumpGeneration();
 
             if (!impl->childWatches.empty()) {
                 ChildEvent event;
@@ -783,6 +790,7 @@ replaceEntryItl(Key key,
         std::atomic_thread_fence(std::memory_order_release);
 
         if (impl->entries.cmp_xchg(oldEntries, newEntries, true)) {
+            this->bumpGeneration();
 
             if (!impl->childWatches.empty()) {
                 ChildEvent event;
@@ -833,6 +841,7 @@ deleteEntry(Key key)
         std::atomic_thread_fence(std::memory_order_release);
 
         if (impl->entries.cmp_xchg(oldEntries, newEntries, true /* defer */)) {
+            this->bumpGeneration();
             using namespace std;
 
             // Make sure children are cleared before we get rid of the
@@ -898,16 +907,24 @@ std::pair<std::shared_ptr<Value>,
 RestCollection<Key, Value>::
 tryGetEntry(Key key) const
 {
-    // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    for (bool loaded = false;;  loaded = true) {
+        {
+            // NOTE: Should not be necessary... investigation needed
+            GcLock::SharedGuard guard(impl->entriesLock);
 
-    auto es = impl->entries.getImmutable();
+            auto es = impl->entries.getImmutable();
 
-    auto it = es->find(key);
-    if (it != es->end())
-        return make_pair(it->second.value, it->second.underConstruction);
+            auto it = es->find(key);
+            if (it != es->end()) {
+                noteUse(key);
+                return make_pair(it->second.value,
+                                 it->second.underConstruction);
+            }
+        }
 
-    return { nullptr, nullptr };
+        if (loaded || !loadOnDemand(key))
+            return { nullptr, nullptr };
+    }
 }
 
 template<typename Key, class Value>
@@ -915,19 +932,26 @@ std::shared_ptr<Value>
 RestCollection<Key, Value>::
 getExistingEntry(Key key) const
 {
-    // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    for (bool loaded = false;;  loaded = true) {
+        {
+            // NOTE: Should not be necessary... investigation needed
+            GcLock::SharedGuard guard(impl->entriesLock);
 
-    auto es = impl->entries.getImmutable();
+            auto es = impl->entries.getImmutable();
 
-    auto it = es->find(key);
-    if (it != es->end() && it->second.value)
-        return it->second.value;
+            auto it = es->find(key);
+            if (it != es->end() && it->second.value) {
+                noteUse(key);
+                return it->second.value;
+            }
 
-    if (it != es->end())
-        this->throwEntryNotReady(key);
-    else
-        this->throwEntryDoesntExist(key);
+            if (it != es->end())
+                this->throwEntryNotReady(key);
+        }
+
+        if (loaded || !loadOnDemand(key))
+            this->throwEntryDoesntExist(key);
+    }
 }
 
 template<typename Key, class Value>
@@ -935,16 +959,38 @@ std::shared_ptr<Value>
 RestCollection<Key, Value>::
 tryGetExistingEntry(Key key) const
 {
-    // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    for (bool loaded = false;;  loaded = true) {
+        {
+            // NOTE: Should not be necessary... investigation needed
+            GcLock::SharedGuard guard(impl->entriesLock);
 
-    auto es = impl->entries.getImmutable();
+            auto es = impl->entries.getImmutable();
 
-    auto it = es->find(key);
-    if (it != es->end())
-        return it->second.value;
+            auto it = es->find(key);
+            if (it != es->end()) {
+                noteUse(key);
+                return it->second.value;
+            }
+        }
 
-    return nullptr;
+        if (loaded || !loadOnDemand(key))
+            return nullptr;
+    }
+}
+
+template<typename Key, class Value>
+bool
+RestCollection<Key, Value>::
+loadOnDemand(const Key & key) const
+{
+    return false;
+}
+
+template<typename Key, class Value>
+void
+RestCollection<Key, Value>::
+noteUse(const Key & key) const
+{
 }
 
 template<typename Key, class Value>
@@ -1253,7 +1299,8 @@ RestConfigurableCollection(const Utf8String & nounSingular,
                            const Utf8String & nounPlural,
                            RestEntity * parent)
     : Base(nounSingular, nounPlural, parent),
-      childWatchActive(false), backgroundCreate(true)
+      childWatchActive(false), lazyByDefault(false), backgroundCreate(true),
+      numLazy(0)
 {
     this->childWatch = this->watchElements("*", true /* catchUp */,
                                            Utf8String("internal child watch"));
@@ -1743,10 +1790,35 @@ loadConfig()
 {
     if (!configStore) return;
 
+    EntityRestorer restorer;
+    addToRestorer(restorer);
+    restorer.start();
+    restorer.wait();
+}
+
+template<typename Key, typename Value,
+         typename Config, typename Status>
+void
+RestConfigurableCollection<Key, Value, Config, Status>::
+addToRestorer(EntityRestorer & restorer, int phase)
+{
+    if (!configStore) return;
+
     for (const auto & key_config: configStore->getAll()) {
         Key key = restDecode(key_config.first, (Key *)0);
-        Config config = jsonDecode<Config>(key_config.second);
-        handlePut(key, config, false);
+        auto config = jsonDecode<Config>(key_config.second);
+        if (objectIsLazy(key, config)) {
+            addLazy(key, std::move(config));
+            continue;
+        }
+
+        auto restore = [=] ()
+            {
+                handlePutSync(key, jsonDecode<Config>(key_config.second),
+                              false);
+            };
+        restorer.add(this->nounPlural, key_config.first, key_config.second,
+                     restore, phase);
     }
 }
 
@@ -1759,6 +1831,181 @@ objectIsPersistent(const Key & key, const Config & config) const
     return true;
 }
 
+template<typename Key, typename Value,
+         typename Config, typename Status>
+bool
+RestConfigurableCollection<Key, Value, Config, Status>::
+objectIsLazy(const Key & key, const Config & config) const
+{
+    return lazyByDefault;
+}
+
+template<typename Key, typename Value,
+         typename Config, typename Status>
+void
+RestConfigurableCollection<Key, Value, Config, Status>::
+addLazy(Key key, Config config)
+{
+    auto entry = std::make_shared<LazyEntry>();
+    entry->config = std::move(config);
+
+    std::unique_lock<std::mutex> guard(lazyMutex);
+    lazyEntries[key] = std::move(entry);
+    numLazy = lazyEntries.size();
+}
+
+template<typename Key, typename Value,
+         typename Config, typename Status>
+auto
+RestConfigurableCollection<Key, Value, Config, Status>::
+getLazyEntry(const Key & key) const -> std::shared_ptr<LazyEntry>
+{
+    if (numLazy == 0)
+        return nullptr;
+    std::unique_lock<std::mutex> guard(lazyMutex);
+    auto it = lazyEntries.find(key);
+    if (it == lazyEntries.end())
+        return nullptr;
+    return it->second;
+}
+
+template<typename Key, typename Value,
+         typename Config, typename Status>
+void
+RestConfigurableCollection<Key, Value, Config, Status>::
+removeLazy(const Key & key)
+{
+    if (numLazy == 0)
+        return;
+    std::unique_lock<std::mutex> guard(lazyMutex);
+    lazyEntries.erase(key);
+    numLazy = lazyEntries.size();
+}
+
+template<typename Key, typename Value,
+         typename Config, typename Status>
+bool
+RestConfigurableCollection<Key, Value, Config, Status>::
+loadOnDemand(const Key & key) const
+{
+    auto entry = getLazyEntry(key);
+    if (!entry)
+        return false;
+
+    // Whoever gets the lock first creates it; the others wait for it
+    std::unique_lock<std::mutex> guard(entry->loadMutex);
+    if (entry->loaded)
+        return true;
+
+    // It isn't added until it's fully constructed, so that lookups
+    // in the meantime come here and wait rather than finding it under
+    // construction
+    auto value = constructCancellable(entry->config, nullptr, WatchT<bool>());
+    std::atomic<BackgroundTaskBase::State>
+        state(BackgroundTaskBase::State::FINISHED);
+    auto * self = const_cast<RestConfigurableCollection *>(this);
+
+    // If it was put in the meantime, the one that was put wins
+    self->addEntryItl(key, std::move(value), false /* mustBeNew */, state);
+    entry->lastUsed = Date::now().secondsSinceEpoch();
+    entry->loaded = true;
+    return true;
+}
+
+template<typename Key, typename Value,
+         typename Config, typename Status>
+void
+RestConfigurableCollection<Key, Value, Config, Status>::
+noteUse(const Key & key) const
+{
+    auto entry = getLazyEntry(key);
+    if (entry)
+        entry->lastUsed = Date::now().secondsSinceEpoch();
+}
+
+template<typename Key, typename Value,
+         typename Config, typename Status>
+size_t
+RestConfigurableCollection<Key, Value, Config, Status>::
+unloadIdle(double idleSeconds)
+{
+    double now = Date::now().secondsSinceEpoch();
+
+    std::vector<std::pair<Key, std::shared_ptr<LazyEntry> > > idle;
+    {
+        std::unique_lock<std::mutex> guard(lazyMutex);
+        for (auto & e: lazyEntries) {
+            if (e.second->loaded && now - e.second->lastUsed >= idleSeconds)
+                idle.emplace_back(e.first, e.second);
+        }
+    }
+
+    size_t result = 0;
+    for (auto & e: idle) {
+        // Skip it if it's being loaded right now
+        std::unique_lock<std::mutex> guard(e.second->loadMutex,
+                                           std::try_to_lock);
+        if (!guard.owns_lock() || !e.second->loaded)
+            continue;
+
+        std::shared_ptr<Value> value;
+        {
+            GcLock::SharedGuard entriesGuard(this->impl->entriesLock);
+            auto es = this->impl->entries.getImmutable();
+            auto it = es->find(e.first);
+            if (it != es->end())
+                value = it->second.value;
+        }
+
+        // Something other than the collection and us has a reference, so
+        // it is in use.  Older versions of the collection that haven't
+        // been reclaimed yet also count, which errs on the side of keeping
+        // it.
+        if (value && value.use_count() > 2)
+            continue;
+
+        if (value)
+            this->deleteEntry(e.first);
+        e.second->loaded = false;
+        ++result;
+    }
+
+    return result;
+}
+
+template<typename Key, typename Value,
+         typename Config, typename Status>
+size_t
+RestConfigurableCollection<Key, Value, Config, Status>::
+numLazyLoaded() const
+{
+    std::unique_lock<std::mutex> guard(lazyMutex);
+    size_t result = 0;
+    for (auto & e: lazyEntries)
+        result += e.second->loaded;
+    return result;
+}
+
+template<typename Key, typename Value,
+         typename Config, typename Status>
+std::vector<Key>
+RestConfigurableCollection<Key, Value, Config, Status>::
+getKeys() const
+{
+    std::vector<Key> result = Base::getKeys();
+    if (numLazy == 0)
+        return result;
+
+    std::unique_lock<std::mutex> guard(lazyMutex);
+    for (auto & e: lazyEntries) {
+        if (!e.second->loaded)
+            result.push_back(e.first);
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
 
 template<typename Key, typename Value,
          typename Config, typename Status>
@@ -1768,6 +2015,9 @@ handlePutItl(Key key, Config config,  const OnDone & onDone, bool mustBeNew)
 {
    setKey(config, key);
 
+    // A new configuration replaces the one that was to be loaded lazily
+    removeLazy(key);
+
     auto savedConfig = jsonEncode(config);
 
     if (backgroundCreate) {
@@ -1847,7 +2097,9 @@ void
 RestConfigurableCollection<Key, Value, Config, Status>::
 handleDelete(Key key)
 {
-    if (this->deleteEntry(key)) {
+    bool wasLazy = !!getLazyEntry(key);
+    removeLazy(key);
+    if (this->deleteEntry(key) || wasLazy) {
         if (this->configStore)
             this->configStore->erase(restEncode(key));
     }
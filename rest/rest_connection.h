@@ -84,6 +84,17 @@ struct RestConnection {
     /** Finish the response, recycling or closing the connection. */
     virtual void finishResponse() = 0;
 
+    /** Wait until no more than maxBytes of the payload given to
+        sendPayload() are still waiting to be written to the other end,
+        so that a slow receiver throttles whatever is producing the
+        payload.  Returns false if the connection was closed.  Connections
+        that don't buffer their payload return immediately.
+    */
+    virtual bool waitForPendingPayload(size_t maxBytes)
+    {
+        return isConnected();
+    }
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
@@ -1480,11 +1480,11 @@ addRouteSyncJsonReturn(RestRequestRouter & router,
                     const RestRequestParsingContext &)
         {
             static std::shared_ptr<ValueDescription> desc(getDefaultDescription((Return *)0));
-            std::ostringstream out;
-            StreamJsonPrintingContext context(out);
+            std::string out;
+            StringJsonPrintingContext context(out);
             desc->printJson(&ret, context);
-            out << std::endl;
-            connection.sendResponse(200, out.str(), "application/json");
+            out += '\n';
+            connection.sendResponse(200, std::move(out), "application/json");
             return RestRequestRouter::MR_YES;
         };
 
@@ -1536,11 +1536,11 @@ addRouteSyncJsonReturnContext(RestRequestRouter & router,
                     const RestRequestParsingContext &)
         {
             static std::shared_ptr<ValueDescription> desc(getDefaultDescription((Return *)0));
-            std::ostringstream out;
-            StreamJsonPrintingContext context(out);
+            std::string out;
+            StringJsonPrintingContext context(out);
             desc->printJson(&ret, context);
-            out << std::endl;
-            connection.sendResponse(200, out.str(), "application/json");
+            out += '\n';
+            connection.sendResponse(200, std::move(out), "application/json");
             return RestRequestRouter::MR_YES;
         };
 
@@ -8,6 +8,7 @@
 
 #include "mldb/types/url.h"
 #include "mldb/rest/rest_request_router.h"
+#include "mldb/rest/latency_metrics.h"
 #include "mldb/utils/vector_utils.h"
 #include "mldb/arch/exception_handler.h"
 #include "mldb/utils/set_utils.h"
@@ -16,6 +17,8 @@
 #include "mldb/utils/string_functions.h"
 #include "mldb/base/less.h"
 #include "mldb/types/value_description.h"
+#include <climits>
+#include <string_view>
 
 
 using namespace std;
@@ -345,6 +348,74 @@ namespace {
 
 EnvOption<bool, true> TRACE_REST_REQUESTS("TRACE_REST_REQUESTS", false);
 
+/// First segment of the given path: its leading character (normally a
+/// '/') and everything up to the next '/'
+std::string_view firstSegment(const std::string & path)
+{
+    std::string_view result(path);
+    auto pos = result.find('/', 1);
+    if (pos != std::string_view::npos)
+        result = result.substr(0, pos);
+    return result;
+}
+
+/** Name of the route that handled the request, made from the paths that
+    matched (with their descriptions, like /<datasetName>, rather than the
+    names in the request) so that there is a bounded number of them.
+*/
+std::string getRouteName(const RestRequestParsingContext & context)
+{
+    std::string result;
+    for (const PathSpec * path: context.paths) {
+        if (!path->desc.empty())
+            result += path->desc.rawString();
+        else result += path->path.rawString();
+    }
+    if (result.empty())
+        result = "/";
+    return result;
+}
+
+/// Verb to put in metrics, so that clients can't create as many as they like
+const std::string & getVerbName(const std::string & verb)
+{
+    static const std::string verbs[] = {
+        "GET", "POST", "PUT", "DELETE", "PATCH", "HEAD"
+    };
+    static const std::string other = "other";
+    for (auto & v: verbs) {
+        if (verb == v)
+            return v;
+    }
+    return other;
+}
+
+LatencyMetric restRequestLatency
+    ("mldb_rest_request_duration_seconds",
+     "Time taken by the handlers of REST routes, by route and verb");
+
+/** Value of the given header to match against a filter.  The Content-Type
+    is parsed out of the other headers, and is matched on its media type
+    alone (without parameters like charset) in lower case.
+*/
+std::string getFilterHeader(const HttpHeader & header,
+                            const std::string & name)
+{
+    if (name != "content-type")
+        return header.tryGetHeader(name);
+    std::string result(header.contentType, 0, header.contentType.find(';'));
+    while (!result.empty() && isspace(result.back()))
+        result.pop_back();
+    for (auto & c: result)
+        c = tolower(c);
+    return result;
+}
+
+size_t hashSegment(std::string_view segment)
+{
+    return std::hash<std::string_view>()(segment);
+}
+
 } // file scope
 
 RestRequestMatchResult
@@ -383,10 +454,59 @@ processRequest(RestConnection & connection,
         if (debug) {
             cerr << "invoked root handler for request " << request << endl;
         }
+        LatencyTimer timer(restRequestLatency.get
+                           ({ { "route", getRouteName(context) },
+                              { "verb", getVerbName(request.verb) } }));
         return rootHandler(connection, request, context);
     }
 
-    for (auto & sr: subRoutes) {
+    // Only the routes that could match the first segment of what remains
+    // are tried, in the order that they were added, which we get by
+    // merging the (sorted) lists of candidates from the index
+    std::string_view segment = firstSegment(context.remaining.rawString());
+
+    static const std::vector<int> noRoutes;
+    auto it = routeIndex.bySegment.find(hashSegment(segment));
+    const std::vector<int> & literals
+        = it == routeIndex.bySegment.end() ? noRoutes : it->second;
+    const std::vector<int> & prefixes = routeIndex.prefixes;
+    const std::vector<int> & others = routeIndex.others;
+
+    auto isPrefix = [&] (int route)
+        {
+            // Exact segment matches were already found through the hash
+            const std::string & path = subRoutes[route].path.path.rawString();
+            return path.size() < segment.size()
+                && segment.compare(0, path.size(), path) == 0;
+        };
+
+    size_t l = 0, p = 0, o = 0;
+    for (;;) {
+        // Routes that don't match put back what they consumed, but not
+        // necessarily in the same buffer
+        segment = firstSegment(context.remaining.rawString());
+
+        while (p < prefixes.size() && !isPrefix(prefixes[p]))
+            ++p;
+
+        int next = INT_MAX;
+        if (l < literals.size())
+            next = literals[l];
+        if (p < prefixes.size())
+            next = std::min(next, prefixes[p]);
+        if (o < others.size())
+            next = std::min(next, others[o]);
+        if (next == INT_MAX)
+            break;
+
+        if (l < literals.size() && literals[l] == next)
+            ++l;
+        if (p < prefixes.size() && prefixes[p] == next)
+            ++p;
+        if (o < others.size() && others[o] == next)
+            ++o;
+
+        auto & sr = subRoutes[next];
         if (debug)
             cerr << "  trying subroute " << sr.router->description << endl;
         try {
@@ -432,6 +552,7 @@ matchPath(RestRequestParsingContext & context) const
     case PathSpec::STRING: {
         if (context.remaining.removePrefix(path.path)) {
             context.resources.push_back(path.path);
+            context.paths.push_back(&path);
             break;
         }
         else return false;
@@ -451,6 +572,7 @@ matchPath(RestRequestParsingContext & context) const
             context.resources.push_back(Url::decodeUri(in));
         }
         context.remaining.replace(0, results[0].length(), "");
+        context.paths.push_back(&path);
         break;
     }
     case PathSpec::NONE:
@@ -494,10 +616,10 @@ process(const RestRequest & request,
         else if (f.location == RequestParamFilter::HEADER) {
             if (debug) {
                 cerr << "matching header " << f.param << " with value "
-                     << request.header.tryGetHeader(f.param)
+                     << getFilterHeader(request.header, f.param)
                      << " against " << f.value << endl;
             }
-            if (request.header.tryGetHeader(f.param) == f.value) {
+            if (getFilterHeader(request.header, f.param) == f.value) {
                 matched = true;
             }
         }
@@ -624,6 +746,26 @@ addRoute(PathSpec path, RequestFilter filter,
 
         throw AnnotatedException(500, message.str());
     }
+    addSubRoute(std::move(route));
+}
+
+void
+RestRequestRouter::
+addSubRoute(Route route)
+{
+    int index = subRoutes.size();
+
+    if (route.path.type == PathSpec::STRING && !route.path.path.empty()) {
+        const std::string & path = route.path.path.rawString();
+        std::string_view segment = firstSegment(path);
+        routeIndex.bySegment[hashSegment(segment)].push_back(index);
+        if (segment.size() == path.size())
+            routeIndex.prefixes.push_back(index);
+    }
+    else {
+        routeIndex.others.push_back(index);
+    }
+
     subRoutes.emplace_back(std::move(route));
 }
 
@@ -977,8 +1119,9 @@ addSubRouter(PathSpec path,
     route.router->notFoundHandler = notFoundHandler;
     route.extractObject = extractObject;
 
-    subRoutes.push_back(route);
-    return *route.router;
+    auto & router = *route.router;
+    addSubRoute(std::move(route));
+    return router;
 }
 
 void
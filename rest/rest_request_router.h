@@ -21,6 +21,7 @@
 #include "mldb/types/annotated_exception.h"
 #include <set>
 #include <functional>
+#include <unordered_map>
 
 namespace MLDB {
 
@@ -332,6 +333,10 @@ struct RestRequestParsingContext {
     /// Part of the resource that has not yet been consumed
     Utf8String remaining;
 
+    /// Paths of the routes that have matched so far, to name the route
+    /// that handled the request in metrics
+    std::vector<const PathSpec *> paths;
+
     /// Used to save the state so that whatever was pushed after can be
     /// removed and the object can get back to its old state (without making
     /// a copy).
@@ -339,6 +344,7 @@ struct RestRequestParsingContext {
         Utf8String remaining;
         int resourcesLength;
         int objectsLength;
+        int pathsLength;
     };
 
     /// Save the current state, to be restored in restoreState
@@ -348,6 +354,7 @@ struct RestRequestParsingContext {
         result.remaining = remaining;
         result.resourcesLength = resources.size();
         result.objectsLength = objects.size();
+        result.pathsLength = paths.size();
         return result;
     }
 
@@ -360,6 +367,8 @@ struct RestRequestParsingContext {
         ExcAssertGreaterEqual(objects.size(), state.objectsLength);
         while (objects.size() > state.objectsLength)
             objects.pop_back();
+        ExcAssertGreaterEqual(paths.size(), state.pathsLength);
+        paths.resize(state.pathsLength);
     }
 
     /// Guard object to save the state and restore it on scope exit
@@ -510,7 +519,9 @@ struct RestRequestRouter {
         been registered.  As a consequence, routes with looser filter
         (e..g. {"PUT"}) MUST be added after identical route with tighter
         filter (e.g. {"PUT", "header:async=true"}).  An exception is
-        thrown when a route is hidden by a looser one. 
+        thrown when a route is hidden by a looser one.  A
+        "header:content-type=..." filter matches the media type of the
+        request's body, ignoring parameters and case.
     */
     /** Add a route that will match the given path and filter and will
         delegate to the given sub-route.
@@ -585,7 +596,7 @@ struct RestRequestRouter {
         route.router = res;
         route.router->description = description;
         route.extractObject = getExtractObject(res.get());
-        subRoutes.push_back(route);
+        addSubRoute(std::move(route));
         return *res;
     }
 
@@ -598,6 +609,27 @@ struct RestRequestRouter {
     Utf8String description;
     bool terminal;
     Json::Value argHelp;
+
+private:
+    /** Index over subRoutes, so that a request only tries the routes that
+        could match the first segment of its remaining path (from its
+        leading '/' up to the next one) rather than all of them.  Routes
+        are still tried in the order they were added.
+    */
+    struct RouteIndex {
+        /// Literal routes, by the hash of the first segment of their path
+        std::unordered_map<size_t, std::vector<int> > bySegment;
+
+        /// Literal routes whose path is a single segment; as well as
+        /// their own segment, they match any segment that they start
+        std::vector<int> prefixes;
+
+        /// Routes that can match any path: regexes and the empty path
+        std::vector<int> others;
+    } routeIndex;
+
+    /// Add the route to subRoutes and index it
+    void addSubRoute(Route route);
 };
 
 /** Send an HTTP response in response to an exception. */
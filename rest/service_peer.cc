@@ -402,7 +402,7 @@ void
 ServicePeer::
 shutdown()
 {
-    httpEndpoint->closePeer();
+    closeEndpoints();
 
     this->shutdown_ = true;
     if (discovery)
@@ -418,7 +418,7 @@ shutdown()
     peers.forEachEntry(cleanupPeer);
     peers.shutdown();
 
-    httpEndpoint->shutdown();
+    closeEndpoints();
 }
 
 std::vector<WatchStatus>
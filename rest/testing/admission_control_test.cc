@@ -0,0 +1,173 @@
+/* admission_control_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test for the admission control of REST requests.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <atomic>
+#include <thread>
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/rest/admission_control.h"
+#include "mldb/rest/rest_request.h"
+#include "mldb/types/date.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+static RestRequest request(const std::string & resource)
+{
+    return RestRequest("GET", resource, RestParams(), "");
+}
+
+BOOST_AUTO_TEST_CASE( test_unlimited_routes_are_admitted )
+{
+    AdmissionControl admission;
+    admission.parseLimits("/v1/query=1");
+
+    std::shared_ptr<void> ticket1, ticket2;
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/datasets"), ticket1),
+                      AdmissionControl::ADMITTED);
+    BOOST_CHECK(!ticket1);
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/datasets"), ticket2),
+                      AdmissionControl::ADMITTED);
+
+    // Segments are compared whole
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/queryCache"), ticket1),
+                      AdmissionControl::ADMITTED);
+    BOOST_CHECK(!ticket1);
+}
+
+BOOST_AUTO_TEST_CASE( test_queue_full )
+{
+    AdmissionControl admission;
+    admission.parseLimits("/v1/query=2");
+
+    std::shared_ptr<void> ticket1, ticket2, ticket3;
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/query"), ticket1),
+                      AdmissionControl::ADMITTED);
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/query"), ticket2),
+                      AdmissionControl::ADMITTED);
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/query"), ticket3),
+                      AdmissionControl::QUEUE_FULL);
+
+    // Releasing a ticket makes room for another request
+    ticket1.reset();
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/query"), ticket3),
+                      AdmissionControl::ADMITTED);
+
+    auto stats = admission.getStats()["/v1/query"];
+    BOOST_CHECK_EQUAL(stats["running"].asInt(), 2);
+    BOOST_CHECK_EQUAL(stats["admitted"].asInt(), 3);
+    BOOST_CHECK_EQUAL(stats["rejectedQueueFull"].asInt(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_wait_and_timeout )
+{
+    AdmissionControl admission;
+    admission.parseLimits("/v1/query=1:1:0.2");
+
+    std::shared_ptr<void> running;
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/query"), running),
+                      AdmissionControl::ADMITTED);
+
+    // Nothing finishes, so the waiting request times out
+    std::shared_ptr<void> waiting;
+    Date before = Date::now();
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/query"), waiting),
+                      AdmissionControl::TIMED_OUT);
+    BOOST_CHECK_GE(Date::now().secondsSince(before), 0.19);
+    BOOST_CHECK(!waiting);
+
+    // The client can ask to wait less
+    RestRequest impatient = request("/v1/query");
+    impatient.header.headers["x-request-timeout"] = "0";
+    BOOST_CHECK_EQUAL(admission.admit(impatient, waiting),
+                      AdmissionControl::TIMED_OUT);
+
+    // Once the running request finishes, the waiting one is admitted
+    std::thread finisher([&] ()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            running.reset();
+        });
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/query"), waiting),
+                      AdmissionControl::ADMITTED);
+    BOOST_CHECK(waiting);
+    finisher.join();
+
+    auto stats = admission.getStats()["/v1/query"];
+    BOOST_CHECK_EQUAL(stats["rejectedTimeout"].asInt(), 2);
+    BOOST_CHECK_EQUAL(stats["running"].asInt(), 1);
+    BOOST_CHECK_EQUAL(stats["waiting"].asInt(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_concurrency_is_limited )
+{
+    AdmissionControl admission;
+    admission.parseLimits("/v1/functions/*/application=3:100:10");
+
+    std::atomic<int> running(0), maxRunning(0), admitted(0);
+
+    auto run = [&] (int i)
+        {
+            std::shared_ptr<void> ticket;
+            auto outcome = admission.admit
+                (request("/v1/functions/f" + to_string(i % 2)
+                         + "/application"), ticket);
+            if (outcome != AdmissionControl::ADMITTED)
+                return;
+            ++admitted;
+            int now = ++running;
+            int prev = maxRunning;
+            while (now > prev && !maxRunning.compare_exchange_weak(prev, now)) ;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            --running;
+        };
+
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < 20;  ++i)
+        threads.emplace_back(run, i);
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(admitted, 20);
+    BOOST_CHECK_LE(maxRunning, 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_longest_rule_wins )
+{
+    AdmissionControl admission;
+    admission.parseLimits("/v1=1,/v1/query=2");
+
+    std::shared_ptr<void> t1, t2, t3, t4;
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/query"), t1),
+                      AdmissionControl::ADMITTED);
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/query"), t2),
+                      AdmissionControl::ADMITTED);
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/datasets"), t3),
+                      AdmissionControl::ADMITTED);
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/datasets"), t4),
+                      AdmissionControl::QUEUE_FULL);
+
+    BOOST_CHECK(admission.removeLimits("/v1/"));
+    BOOST_CHECK(!admission.removeLimits("/v1"));
+    BOOST_CHECK_EQUAL(admission.admit(request("/v1/datasets"), t4),
+                      AdmissionControl::ADMITTED);
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_errors )
+{
+    AdmissionControl admission;
+    BOOST_CHECK_THROW(admission.parseLimits("/v1/query"), std::exception);
+    BOOST_CHECK_THROW(admission.parseLimits("/v1/query=x"), std::exception);
+    BOOST_CHECK_THROW(admission.parseLimits("/v1/query=1:2:3:4"),
+                      std::exception);
+    BOOST_CHECK_THROW(admission.parseLimits("/v1/query=0"), std::exception);
+    BOOST_CHECK_EQUAL(admission.getStats().size(), 0);
+}
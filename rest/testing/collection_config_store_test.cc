@@ -0,0 +1,141 @@
+/** collection_config_store_test.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test of the stores of the configuration of collections.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/rest/collection_config_store.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/vfs/filter_streams.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <thread>
+#include <chrono>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+struct TempDir {
+    TempDir()
+        : path(boost::filesystem::temp_directory_path()
+               / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(path);
+    }
+
+    ~TempDir()
+    {
+        boost::filesystem::remove_all(path);
+    }
+
+    std::string uri(const std::string & name) const
+    {
+        return "file://" + (path / name).string();
+    }
+
+    boost::filesystem::path path;
+};
+
+Json::Value config(const std::string & type)
+{
+    Json::Value result;
+    result["type"] = type;
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(test_synchronous)
+{
+    TempDir dir;
+    S3CollectionConfigStore store(dir.uri("datasets"));
+    BOOST_CHECK(!store.isWriteBehind());
+
+    store.set("ds1", config("sparse.mutable"));
+    BOOST_CHECK(boost::filesystem::exists(dir.path / "datasets" / "ds1"));
+    BOOST_CHECK_EQUAL(store.get("ds1")["type"].asString(), "sparse.mutable");
+
+    store.erase("ds1");
+    BOOST_CHECK(store.keys().empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_write_behind)
+{
+    TempDir dir;
+    std::string snapshot = (dir.path / "functions.snapshot.json").string();
+
+    {
+        S3CollectionConfigStore store(dir.uri("functions"), 3600.0);
+        BOOST_CHECK(store.isWriteBehind());
+
+        for (int i = 0;  i < 1000;  ++i)
+            store.set("fn" + to_string(i), config("sql.query"));
+        store.erase("fn999");
+
+        // Nothing is written until the interval is up or we ask for it...
+        BOOST_CHECK(!boost::filesystem::exists(snapshot));
+        BOOST_CHECK_EQUAL(store.keys().size(), 999);
+        BOOST_CHECK_EQUAL(store.get("fn5")["type"].asString(), "sql.query");
+        BOOST_CHECK_THROW(store.get("fn999"), std::exception);
+
+        // ... and then it's all written as one object
+        store.sync();
+        BOOST_CHECK(boost::filesystem::exists(snapshot));
+        BOOST_CHECK(boost::filesystem::is_empty(dir.path / "functions"));
+
+        store.erase("fn0");
+        // Not synced; written on destruction
+    }
+
+    S3CollectionConfigStore store(dir.uri("functions"), 3600.0);
+    auto all = store.getAll();
+    BOOST_CHECK_EQUAL(all.size(), 998);
+    BOOST_CHECK_EQUAL(all[0].first, "fn1");
+    BOOST_CHECK_EQUAL(all[0].second["type"].asString(), "sql.query");
+}
+
+BOOST_AUTO_TEST_CASE(test_flush_interval)
+{
+    TempDir dir;
+    std::string snapshot = (dir.path / "procedures.snapshot.json").string();
+
+    S3CollectionConfigStore store(dir.uri("procedures"), 0.05);
+    store.set("proc", config("transform"));
+
+    for (int i = 0;  i < 200 && !boost::filesystem::exists(snapshot);  ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    BOOST_CHECK(boost::filesystem::exists(snapshot));
+
+    filter_istream stream(snapshot);
+    Json::Value written;
+    stream >> written;
+    BOOST_CHECK_EQUAL(written["entries"]["proc"]["type"].asString(),
+                      "transform");
+}
+
+BOOST_AUTO_TEST_CASE(test_migrate_from_synchronous)
+{
+    TempDir dir;
+    {
+        S3CollectionConfigStore store(dir.uri("datasets"));
+        store.set("ds1", config("sparse.mutable"));
+        store.set("ds2", config("tabular"));
+    }
+
+    S3CollectionConfigStore store(dir.uri("datasets"), 3600.0);
+    BOOST_CHECK(store.keys() == vector<Utf8String>({"ds1", "ds2"}));
+    store.set("ds2", config("beh"));
+    store.sync();
+
+    // The objects stored one by one are gone, and the snapshot wins
+    BOOST_CHECK(boost::filesystem::is_empty(dir.path / "datasets"));
+    S3CollectionConfigStore reloaded(dir.uri("datasets"), 3600.0);
+    BOOST_CHECK_EQUAL(reloaded.get("ds1")["type"].asString(), "sparse.mutable");
+    BOOST_CHECK_EQUAL(reloaded.get("ds2")["type"].asString(), "beh");
+}
@@ -0,0 +1,208 @@
+/** entity_restorer_test.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test of the restoration of entities in the order of their dependencies.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/rest/entity_restorer.h"
+#include "mldb/types/value_description.h"
+
+#include <boost/test/unit_test.hpp>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+/// Records the order in which entities finish restoring
+struct Order {
+    std::mutex mutex;
+    std::vector<std::string> done;
+
+    std::function<void ()> restore(std::string name, int sleepMs = 0)
+    {
+        return [=] ()
+            {
+                if (sleepMs)
+                    std::this_thread::sleep_for
+                        (std::chrono::milliseconds(sleepMs));
+                std::unique_lock<std::mutex> guard(mutex);
+                done.push_back(name);
+            };
+    }
+
+    int position(const std::string & name)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = std::find(done.begin(), done.end(), name);
+        BOOST_REQUIRE(it != done.end());
+        return it - done.begin();
+    }
+};
+
+Json::Value params(const std::string & query)
+{
+    Json::Value result;
+    result["type"] = "sql.query";
+    result["params"]["query"] = query;
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(test_find_references)
+{
+    std::set<Utf8String> names = { "ds", "ds2", "fn" };
+
+    Json::Value config;
+    config["query"] = "SELECT fn(x) FROM ds WHERE ds_x > 1";
+    config["other"] = "ds2x";
+    auto refs = EntityRestorer::findReferences(config, names);
+    BOOST_CHECK_EQUAL(refs.size(), 2);
+    BOOST_CHECK(refs.count("ds"));
+    BOOST_CHECK(refs.count("fn"));
+
+    // Within arrays and nested objects
+    Json::Value nested;
+    nested["inputData"][0]["from"] = "ds2";
+    refs = EntityRestorer::findReferences(nested, names);
+    BOOST_CHECK_EQUAL(refs.size(), 1);
+    BOOST_CHECK(refs.count("ds2"));
+}
+
+BOOST_AUTO_TEST_CASE(test_dependency_order)
+{
+    Order order;
+    EntityRestorer restorer(4);
+
+    // The function is added first, but must wait for the dataset
+    restorer.add("functions", "fn", params("SELECT * FROM ds"),
+                 order.restore("fn"), 1);
+    restorer.add("datasets", "ds", Json::Value(),
+                 order.restore("ds", 50), 1);
+    restorer.add("procedures", "unrelated", params("SELECT 1"),
+                 order.restore("unrelated"), 1);
+    restorer.start();
+    restorer.wait();
+
+    BOOST_CHECK_LT(order.position("ds"), order.position("fn"));
+
+    auto status = restorer.getStatus();
+    BOOST_CHECK(status.ready);
+    BOOST_CHECK_EQUAL(status.numLoaded, 3);
+    BOOST_CHECK_EQUAL(status.entities[0].dependsOn.size(), 1);
+    BOOST_CHECK_EQUAL(status.entities[0].dependsOn[0], "datasets/ds");
+    BOOST_CHECK(status.entities[1].dependsOn.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_phases)
+{
+    Order order;
+    EntityRestorer restorer(4);
+
+    restorer.add("datasets", "ds", Json::Value(), order.restore("ds"), 1);
+    restorer.add("plugins", "plugin", Json::Value(),
+                 order.restore("plugin", 50), 0);
+    restorer.start();
+    restorer.wait();
+
+    BOOST_CHECK_LT(order.position("plugin"), order.position("ds"));
+}
+
+BOOST_AUTO_TEST_CASE(test_cycle)
+{
+    Order order;
+    EntityRestorer restorer(2);
+
+    restorer.add("functions", "a", params("SELECT b()"), order.restore("a"));
+    restorer.add("functions", "b", params("SELECT a()"), order.restore("b"));
+    restorer.start();
+    restorer.wait();
+
+    // The cycle is broken at the first one
+    BOOST_CHECK_EQUAL(order.position("a"), 0);
+    BOOST_CHECK_EQUAL(order.position("b"), 1);
+    BOOST_CHECK(restorer.getStatus().ready);
+}
+
+BOOST_AUTO_TEST_CASE(test_failure)
+{
+    Order order;
+    EntityRestorer restorer(2);
+
+    restorer.add("datasets", "ds", Json::Value(),
+                 [] () { throw std::runtime_error("bad dataset"); });
+    restorer.add("functions", "fn", params("SELECT * FROM ds"),
+                 order.restore("fn"));
+    restorer.start();
+    restorer.wait();
+
+    // The entities that depend on one that failed are tried anyway
+    auto status = restorer.getStatus();
+    BOOST_CHECK(status.ready);
+    BOOST_CHECK_EQUAL(status.numFailed, 1);
+    BOOST_CHECK_EQUAL(status.numLoaded, 1);
+    BOOST_CHECK(status.entities[0].state == EntityRestoreState::FAILED);
+    BOOST_CHECK_EQUAL(status.entities[0].error, "bad dataset");
+    BOOST_CHECK(status.entities[1].state == EntityRestoreState::LOADED);
+    BOOST_CHECK_EQUAL(jsonEncode(status)["entities"][0]["state"].asString(),
+                      "failed");
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrency)
+{
+    std::atomic<int> running(0), maxRunning(0);
+    EntityRestorer restorer(3);
+
+    for (int i = 0;  i < 12;  ++i) {
+        auto restore = [&] ()
+            {
+                int n = ++running;
+                int m = maxRunning;
+                while (n > m && !maxRunning.compare_exchange_weak(m, n)) ;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                --running;
+            };
+        restorer.add("datasets", "ds" + std::to_string(i), Json::Value(),
+                     restore);
+    }
+    restorer.start();
+    restorer.wait();
+
+    BOOST_CHECK_LE(maxRunning, 3);
+    BOOST_CHECK_EQUAL(restorer.getStatus().numLoaded, 12);
+}
+
+BOOST_AUTO_TEST_CASE(test_cancel)
+{
+    std::atomic<int> numRestored(0);
+    EntityRestorer restorer(1);
+
+    for (int i = 0;  i < 10;  ++i) {
+        restorer.add("datasets", "ds" + std::to_string(i), Json::Value(),
+                     [&] ()
+                     {
+                         std::this_thread::sleep_for
+                             (std::chrono::milliseconds(20));
+                         ++numRestored;
+                     });
+    }
+    restorer.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    restorer.cancel();
+    restorer.wait();
+
+    auto status = restorer.getStatus();
+    BOOST_CHECK(!status.ready);
+    BOOST_CHECK_LT(numRestored, 10);
+    BOOST_CHECK_EQUAL(status.numLoaded, numRestored);
+    BOOST_CHECK_EQUAL(status.numLoading, 0);
+}
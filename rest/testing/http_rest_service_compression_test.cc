@@ -0,0 +1,114 @@
+/* http_rest_service_compression_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test for the compression of the responses of the HTTP REST service.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <memory>
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/rest/http_rest_service.h"
+#include "mldb/http/http_rest_proxy.h"
+#include "mldb/vfs/compressor.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+struct TextService : public HttpRestService {
+
+    TextService()
+        : HttpRestService(false /* enableLogging */)
+    {
+        init();
+        setCompression(1000);
+    }
+
+    ~TextService()
+    {
+        shutdown();
+    }
+
+    static std::string bigBody()
+    {
+        std::string result;
+        for (int i = 0;  i < 10000;  ++i)
+            result += "line " + to_string(i) + "\n";
+        return result;
+    }
+
+    virtual void handleRequest(RestConnection & connection,
+                               const RestRequest & request) const
+    {
+        if (request.resource == "/big")
+            connection.sendResponse(200, bigBody(), "text/plain");
+        else connection.sendResponse(200, string("small"), "text/plain");
+    }
+};
+
+static std::string decompress(const std::string & encoding,
+                              const std::string & data)
+{
+    std::unique_ptr<Decompressor> decompressor
+        (Decompressor::create(encoding));
+    BOOST_REQUIRE(decompressor);
+    std::string result;
+    auto onData = [&] (const char * data, size_t len)
+        {
+            result.append(data, len);
+            return len;
+        };
+    decompressor->decompress(data.data(), data.size(), onData);
+    decompressor->finish(onData);
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( test_compression )
+{
+    TextService service;
+    auto addr = service.bindTcp(PortRange(22000, 23000), "localhost");
+    HttpRestProxy proxy(addr);
+
+    auto get = [&] (const std::string & resource,
+                    const std::string & acceptEncoding)
+        {
+            RestParams headers;
+            if (!acceptEncoding.empty())
+                headers.emplace_back("Accept-Encoding", acceptEncoding);
+            auto response = proxy.get(resource, {}, headers);
+            BOOST_CHECK_EQUAL(response.code(), 200);
+            return response;
+        };
+
+    // Not asked for
+    auto response = get("/big", "");
+    BOOST_CHECK(!response.hasHeader("content-encoding"));
+    BOOST_CHECK_EQUAL(response.body(), TextService::bigBody());
+
+    // Preferred encoding
+    response = get("/big", "gzip, zstd");
+    BOOST_CHECK_EQUAL(response.getHeader("content-encoding"), "zstd");
+    BOOST_CHECK_LT(response.body().size(), TextService::bigBody().size());
+    BOOST_CHECK_EQUAL(decompress("zstd", response.body()),
+                      TextService::bigBody());
+
+    // Refused encodings are skipped
+    response = get("/big", "zstd;q=0, GZIP");
+    BOOST_CHECK_EQUAL(response.getHeader("content-encoding"), "gzip");
+    BOOST_CHECK_EQUAL(decompress("gzip", response.body()),
+                      TextService::bigBody());
+
+    // Unknown encodings only
+    response = get("/big", "br");
+    BOOST_CHECK(!response.hasHeader("content-encoding"));
+    BOOST_CHECK_EQUAL(response.body(), TextService::bigBody());
+
+    // Below the threshold
+    response = get("/small", "gzip");
+    BOOST_CHECK(!response.hasHeader("content-encoding"));
+    BOOST_CHECK_EQUAL(response.body(), "small");
+}
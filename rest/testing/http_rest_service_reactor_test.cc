@@ -0,0 +1,107 @@
+/* http_rest_service_reactor_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test for the multi-reactor mode of the HTTP REST service.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/rest/http_rest_service.h"
+#include "mldb/http/http_rest_proxy.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+struct EchoService : public HttpRestService {
+
+    EchoService(int numReactors)
+        : HttpRestService(false /* enableLogging */)
+    {
+        init();
+        setReactors(numReactors, false /* pinThreads */);
+    }
+
+    ~EchoService()
+    {
+        shutdown();
+    }
+
+    virtual void handleRequest(RestConnection & connection,
+                               const RestRequest & request) const
+    {
+        {
+            std::unique_lock<std::mutex> guard(threadsLock);
+            threads.insert(std::this_thread::get_id());
+        }
+        connection.sendResponse(200, request.payload, "text/plain");
+    }
+
+    mutable std::mutex threadsLock;
+    mutable std::set<std::thread::id> threads;
+};
+
+BOOST_AUTO_TEST_CASE( test_reactors )
+{
+    int numReactors = 4;
+    EchoService service(numReactors);
+    BOOST_CHECK_EQUAL(service.numReactors(), numReactors);
+
+    auto addr = service.bindTcp(PortRange(22000, 23000), "localhost");
+    cerr << "echo service is listening on " << addr << endl;
+
+    std::atomic<int> numPings(0);
+    int totalPings = 2000;
+    std::mutex checkLock;
+
+    auto runHttpThread = [&] ()
+        {
+            while (numPings < totalPings) {
+                // A new connection each time, so that they're spread over
+                // the reactors
+                HttpRestProxy proxy(addr);
+                int i = ++numPings;
+                auto response = proxy.post("/echo", to_string(i));
+                std::unique_lock<std::mutex> checkGuard(checkLock);
+                BOOST_CHECK_EQUAL(response.code(), 200);
+                BOOST_CHECK_EQUAL(response.body(), to_string(i));
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0;  i < 8;  ++i) {
+       threads.emplace_back(runHttpThread);
+    }
+    for (auto & t: threads)
+        t.join();
+
+    // Requests are handled on the reactor threads, and never on ours
+    BOOST_CHECK_LE(service.threads.size(), numReactors);
+    BOOST_CHECK_EQUAL(service.threads.count(std::this_thread::get_id()), 0);
+
+    service.shutdown();
+}
+
+BOOST_AUTO_TEST_CASE( test_reactors_dont_share_ports )
+{
+    // A second service must not join the listening sockets of the first
+    EchoService service1(2);
+    EchoService service2(2);
+
+    auto addr1 = service1.bindTcp(PortRange(23000, 24000), "localhost");
+    auto addr2 = service2.bindTcp(PortRange(23000, 24000), "localhost");
+    BOOST_CHECK_NE(addr1, addr2);
+
+    HttpRestProxy proxy1(addr1), proxy2(addr2);
+    BOOST_CHECK_EQUAL(proxy1.post("/echo", string("1")).body(), "1");
+    BOOST_CHECK_EQUAL(proxy2.post("/echo", string("2")).body(), "2");
+    BOOST_CHECK_EQUAL(service1.threads.size() + service2.threads.size(), 2);
+}
@@ -0,0 +1,131 @@
+/* latency_metrics_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test for the latency histograms and their Prometheus export.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <thread>
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/rest/latency_metrics.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_buckets )
+{
+    typedef LatencyHistogram H;
+
+    // Buckets are contiguous, and each value falls within its bucket
+    for (int i = 0;  i + 1 < H::NUM_BUCKETS;  ++i) {
+        BOOST_REQUIRE_EQUAL(H::getBucketUpperBound(i),
+                            H::getBucketLowerBound(i + 1));
+        BOOST_REQUIRE_EQUAL(H::getBucket(H::getBucketLowerBound(i)), i);
+        BOOST_REQUIRE_EQUAL(H::getBucket(H::getBucketUpperBound(i) - 1), i);
+    }
+
+    // Buckets are never wider than an eighth of their value
+    for (int i = H::SUB_BUCKETS;  i < H::NUM_BUCKETS;  ++i) {
+        uint64_t width = H::getBucketUpperBound(i) - H::getBucketLowerBound(i);
+        BOOST_CHECK_LE(width * H::SUB_BUCKETS, H::getBucketLowerBound(i));
+    }
+
+    // Huge values go in the last bucket
+    BOOST_CHECK_EQUAL(H::getBucket((uint64_t)-1), H::NUM_BUCKETS - 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_quantiles )
+{
+    LatencyHistogram histogram;
+    BOOST_CHECK_EQUAL(histogram.snapshot().quantile(0.5), 0.0);
+
+    for (int i = 1;  i <= 1000;  ++i)
+        histogram.record(i * 1000);  // 1ms to 1s
+
+    auto snapshot = histogram.snapshot();
+    BOOST_CHECK_EQUAL(snapshot.count, 1000);
+    BOOST_CHECK_EQUAL(snapshot.sumMicros, 1000 * 1001 / 2 * 1000);
+    BOOST_CHECK_CLOSE(snapshot.quantile(0.5), 0.5, 12.5);
+    BOOST_CHECK_CLOSE(snapshot.quantile(0.99), 0.99, 12.5);
+    BOOST_CHECK_CLOSE(snapshot.quantile(1.0), 1.0, 12.5);
+}
+
+BOOST_AUTO_TEST_CASE( test_concurrent_recording )
+{
+    LatencyMetric metric("test_concurrent_seconds", "Test");
+
+    std::vector<std::thread> threads;
+    for (int t = 0;  t < 8;  ++t) {
+        threads.emplace_back([&, t] ()
+            {
+                for (int i = 0;  i < 10000;  ++i) {
+                    metric.recordSeconds({ { "thread", to_string(t % 2) } },
+                                         0.001);
+                }
+            });
+    }
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(metric.get({ { "thread", "0" } }).snapshot().count,
+                      40000);
+    BOOST_CHECK_EQUAL(metric.get({ { "thread", "1" } }).snapshot().count,
+                      40000);
+}
+
+BOOST_AUTO_TEST_CASE( test_prometheus_text )
+{
+    std::string text;
+    {
+        LatencyMetric metric("test_requests_seconds", "Time taken by tests");
+        auto & h = metric.get({ { "route", "/v1/\"quoted\"" },
+                                { "verb", "GET" } });
+        h.recordSeconds(0.0004);
+        h.recordSeconds(0.003);
+        h.recordSeconds(20);
+
+        {
+            LatencyTimer timer(metric.get({}));
+        }
+
+        text = getLatencyMetricsText();
+    }
+
+    cerr << text;
+
+    auto contains = [&] (const std::string & line)
+        {
+            return text.find(line + "\n") != std::string::npos;
+        };
+
+    BOOST_CHECK(contains("# HELP test_requests_seconds Time taken by tests"));
+    BOOST_CHECK(contains("# TYPE test_requests_seconds histogram"));
+
+    std::string labels = "route=\"/v1/\\\"quoted\\\"\",verb=\"GET\"";
+    BOOST_CHECK(contains("test_requests_seconds_bucket{" + labels
+                         + ",le=\"0.00025\"} 0"));
+    BOOST_CHECK(contains("test_requests_seconds_bucket{" + labels
+                         + ",le=\"0.0005\"} 1"));
+    BOOST_CHECK(contains("test_requests_seconds_bucket{" + labels
+                         + ",le=\"0.0025\"} 1"));
+    BOOST_CHECK(contains("test_requests_seconds_bucket{" + labels
+                         + ",le=\"0.005\"} 2"));
+    BOOST_CHECK(contains("test_requests_seconds_bucket{" + labels
+                         + ",le=\"30\"} 3"));
+    BOOST_CHECK(contains("test_requests_seconds_bucket{" + labels
+                         + ",le=\"+Inf\"} 3"));
+    BOOST_CHECK(contains("test_requests_seconds_count{" + labels + "} 3"));
+    BOOST_CHECK(contains("test_requests_seconds_sum{" + labels
+                         + "} 20.0034"));
+
+    BOOST_CHECK(contains("test_requests_seconds_count 1"));
+
+    // Once the metric is destroyed, it's no longer exported
+    BOOST_CHECK(getLatencyMetricsText().find("test_requests_seconds")
+                == std::string::npos);
+}
@@ -646,3 +646,69 @@ BOOST_AUTO_TEST_CASE( stress_test_collection_cancellation )
          << endl;
     BOOST_CHECK_EQUAL(created + underConstruction, deletedAfterCreation + cancelledBeforeCreation);
 }
+
+struct CountingTestCollection: public TestCollection {
+    mutable std::atomic<int> numConstructed{0};
+
+    std::shared_ptr<TestObject>
+    construct(TestConfig config, const OnProgress & onProgress) const
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ++numConstructed;
+        return TestCollection::construct(std::move(config), onProgress);
+    }
+};
+
+BOOST_AUTO_TEST_CASE( test_lazy_entries )
+{
+    CountingTestCollection collection;
+    collection.addLazy("item1", TestConfig{"item1", { { "key1", "value1" } } });
+
+    // It's listed, but not created until it's used
+    BOOST_CHECK_EQUAL(collection.getKeys(), vector<string>({"item1"}));
+    BOOST_CHECK_EQUAL(collection.numConstructed, 0);
+    BOOST_CHECK_EQUAL(collection.numLazyLoaded(), 0);
+
+    // Concurrent first uses create it once
+    std::vector<std::thread> threads;
+    for (unsigned i = 0;  i < 4;  ++i) {
+        threads.emplace_back([&] ()
+                             {
+                                 auto obj = collection.getExistingEntry("item1");
+                                 BOOST_CHECK_EQUAL(obj->config->params["key1"],
+                                                   "value1");
+                             });
+    }
+    for (auto & t: threads)
+        t.join();
+    BOOST_CHECK_EQUAL(collection.numConstructed, 1);
+    BOOST_CHECK_EQUAL(collection.numLazyLoaded(), 1);
+    BOOST_CHECK_EQUAL(collection.getKeys(), vector<string>({"item1"}));
+
+    // Nothing has been idle for an hour
+    BOOST_CHECK_EQUAL(collection.unloadIdle(3600), 0);
+
+    // An entity that is referenced elsewhere isn't unloaded
+    {
+        auto obj = collection.getExistingEntry("item1");
+        BOOST_CHECK_EQUAL(collection.unloadIdle(0), 0);
+    }
+
+    BOOST_CHECK_EQUAL(collection.unloadIdle(0), 1);
+    BOOST_CHECK_EQUAL(collection.numLazyLoaded(), 0);
+    BOOST_CHECK_EQUAL(collection.getKeys(), vector<string>({"item1"}));
+
+    // It's created again the next time it's used
+    BOOST_CHECK(collection.tryGetExistingEntry("item1"));
+    BOOST_CHECK_EQUAL(collection.numConstructed, 2);
+
+    // Unknown keys still aren't found
+    BOOST_CHECK(!collection.tryGetExistingEntry("item2"));
+    BOOST_CHECK_THROW(collection.getExistingEntry("item2"), std::exception);
+
+    // Once deleted, it isn't created again
+    collection.handleDelete("item1");
+    BOOST_CHECK(!collection.tryGetExistingEntry("item1"));
+    BOOST_CHECK(collection.getKeys().empty());
+    BOOST_CHECK_EQUAL(collection.numConstructed, 2);
+}
@@ -0,0 +1,110 @@
+/* rest_request_router_bench.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Benchmark routing of requests through a RestRequestRouter with many
+   routes, shaped like the MLDB REST API.
+*/
+
+#include <iostream>
+#include <string>
+
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "mldb/utils/testing/benchmarks.h"
+#include "mldb/rest/rest_request_router.h"
+#include "mldb/rest/in_process_rest_connection.h"
+
+using namespace std;
+namespace po = boost::program_options;
+using namespace MLDB;
+
+int
+main(int argc, char ** argv)
+{
+    int numRoutes = 200;
+    int numRequests = 100000;
+    int numIterations = 5;
+
+    po::options_description all_opt;
+    all_opt.add_options()
+        ("num-routes,r", po::value(&numRoutes),
+         "Number of literal routes next to the collections")
+        ("num-requests,n", po::value(&numRequests),
+         "Number of requests to route for each path")
+        ("iterations,i", po::value(&numIterations),
+         "Number of times to run each benchmark")
+        ("help,h", "print this message");
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv)
+              .options(all_opt)
+              .run(),
+              vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        cerr << all_opt << endl;
+        return 1;
+    }
+
+    auto respond = [] (RestConnection & connection,
+                       const RestRequest & request,
+                       RestRequestParsingContext & context)
+        {
+            connection.sendResponse(200, "", "text/plain");
+            return RestRequestRouter::MR_YES;
+        };
+
+    RestRequestRouter router;
+    auto & v1 = router.addSubRouter("/v1", "version 1 of the API");
+
+    for (int i = 0;  i < numRoutes;  ++i) {
+        v1.addRoute("/route" + to_string(i), "GET", "literal route",
+                    respond, Json::Value());
+    }
+
+    for (string collection: { "datasets", "procedures", "plugins", "types",
+                              "functions" }) {
+        auto & coll = v1.addSubRouter("/" + collection, collection);
+        coll.addRoute("", "GET", "list", respond, Json::Value());
+        auto & entity = coll.addSubRouter(Rx("/([^/]+)", "/<name>"), "entity");
+        entity.addRoute("", "GET", "status", respond, Json::Value());
+        entity.addRoute("/application", { "GET", "POST" }, "apply",
+                        respond, Json::Value());
+        entity.addRoute("/info", "GET", "info", respond, Json::Value());
+    }
+    v1.addRoute("/query", "GET", "query", respond, Json::Value());
+
+    Benchmarks bms;
+    vector<string> paths = {
+        "/v1/functions/f123/application",
+        "/v1/datasets",
+        "/v1/route" + to_string(numRoutes - 1),
+        "/v1/query",
+        "/v1/unknown"
+    };
+
+    for (int it = 0;  it < numIterations;  ++it) {
+        for (auto & path: paths) {
+            RestRequest request;
+            request.verb = "GET";
+            request.resource = path;
+
+            Benchmark bm(bms, path);
+            for (int i = 0;  i < numRequests;  ++i) {
+                auto conn = InProcessRestConnection::create();
+                router.handleRequest(*conn, request);
+            }
+        }
+    }
+
+    cerr << "total times for " << numIterations << " iterations of "
+         << numRequests << " requests with " << numRoutes
+         << " literal routes:" << endl;
+    bms.dumpTotals();
+
+    return 0;
+}
@@ -118,3 +118,53 @@ BOOST_AUTO_TEST_CASE( test_hidden_route )
                                        "Not matching regex", callback,
                     Json::Value());
 }
+
+BOOST_AUTO_TEST_CASE( test_route_order_and_prefixes )
+{
+    RestRequestRouter router;
+
+    auto respondWith = [] (std::string body)
+        {
+            return [=] (RestConnection & connection,
+                        const RestRequest & request,
+                        RestRequestParsingContext & context)
+            {
+                connection.sendResponse(200, body, "text/plain");
+                return RestRequestRouter::MR_YES;
+            };
+        };
+
+    // Literal routes are a string prefix of the path, not a whole segment,
+    // and routes are tried in the order that they were added whatever
+    // their kind
+    router.addRoute("/ab", "GET", "Prefix", respondWith("prefix"),
+                    Json::Value());
+    router.addRoute(Rx("/a([a-z]*)", ""), "GET", "Regex",
+                    respondWith("regex"), Json::Value());
+    router.addRoute("/abc/d", "GET", "Deep", respondWith("deep"),
+                    Json::Value());
+    router.addRoute("/", "GET", "Root", respondWith("root"),
+                    Json::Value());
+    router.addRoute("/b/c", "GET", "Other", respondWith("other"),
+                    Json::Value());
+
+    auto get = [&] (const std::string & resource)
+        {
+            RestRequest request;
+            request.verb = "GET";
+            request.resource = resource;
+            auto conn = InProcessRestConnection::create();
+            router.handleRequest(*conn, request);
+            if (conn->responseCode() != 200)
+                return std::to_string(conn->responseCode());
+            return conn->response();
+        };
+
+    BOOST_CHECK_EQUAL(get("/ab"), "prefix");
+    BOOST_CHECK_EQUAL(get("/abc"), "regex");
+    BOOST_CHECK_EQUAL(get("/abc/d"), "deep");
+    BOOST_CHECK_EQUAL(get("/"), "root");
+    BOOST_CHECK_EQUAL(get("/b/c"), "other");
+    BOOST_CHECK_EQUAL(get("/b/d"), "404");
+    BOOST_CHECK_EQUAL(get("/xyz"), "404");
+}
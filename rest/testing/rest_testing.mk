@@ -10,6 +10,8 @@ ETCD_MANUAL:=$(if $(HAS_ETCD),,manual)
 $(eval $(call test,link_test,link,boost timed valgrind))
 $(eval $(call test,rest_collection_test,service_peer,boost timed))
 $(eval $(call test,rest_collection_stress_test,service_peer,boost timed))
+$(eval $(call test,entity_restorer_test,rest_entity,boost))
+$(eval $(call test,collection_config_store_test,rest_entity vfs boost_filesystem,boost))
 $(eval $(call test,service_peer_test,service_peer,boost $(ETCD_MANUAL) timed))
 $(eval $(call test,service_peer_startup_test,service_peer,boost $(ETCD_MANUAL) timed))
 $(eval $(call test,service_peer_process_discovery_test,service_peer runner,boost $(ETCD_MANUAL) timed))
@@ -32,6 +34,11 @@ $(TESTS)/service_peer_process_discovery_test: \
 	$(BIN)/test_peer_runner \
 
 $(eval $(call test,rest_service_endpoint_test,rest,boost manual))
+$(eval $(call test,http_rest_service_reactor_test,rest,boost timed))
+$(eval $(call test,http_rest_service_compression_test,rest vfs,boost timed))
+$(eval $(call test,admission_control_test,rest,boost timed))
+$(eval $(call test,latency_metrics_test,rest,boost))
 $(eval $(call test,rest_request_router_test,rest,boost))
 $(eval $(call test,rest_request_binding_test,rest,boost))
+$(eval $(call program,rest_request_router_bench,rest test_utils boost_program_options))
 
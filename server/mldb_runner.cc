@@ -85,6 +85,10 @@ int main(int argc, char ** argv)
     options_description plugin_options("Plugin options");
 
     int numThreads(16);
+    int httpReactors(0);
+    bool unpinnedHttpReactors = false;
+    ssize_t httpCompressMinBytes(-1);
+    int httpCompressLevel(-1);
     // Defaults for operational characteristics
     string httpListenPort = "11700-18000";
     string httpListenHost = "0.0.0.0";
@@ -129,6 +133,18 @@ int main(int argc, char ** argv)
          "Base path in etcd")
 #endif
         ("num-threads,t", value(&numThreads), "Number of HTTP worker threads")
+        ("http-reactors", value(&httpReactors),
+         "Number of independent HTTP event loops, each with its own thread "
+         "and listening socket (0 to share one event loop between the "
+         "worker threads)")
+        ("http-unpinned-reactors", bool_switch(&unpinnedHttpReactors),
+         "Don't pin the threads of the HTTP event loops to cores")
+        ("http-compress-min-bytes", value(&httpCompressMinBytes),
+         "Compress HTTP responses of at least this many bytes, and chunked "
+         "responses, for clients that accept gzip or zstd (-1, the "
+         "default, to never compress)")
+        ("http-compress-level", value(&httpCompressLevel),
+         "Compression level for HTTP responses (-1 for a fast default)")
         ("http-listen-port,p",
          value(&httpListenPort)->default_value(httpListenPort),
          "Port to listen on for HTTP")
@@ -240,6 +256,12 @@ int main(int argc, char ** argv)
         exit(1);
     }
 
+    if (httpReactors < 0) {
+        cerr << MLDB::format("'http-reactors' cannot be negative: %d\n",
+                             httpReactors);
+        exit(1);
+    }
+
     // Add these first so that if needed they can be used to load the credentials
     // file
     if (!addCredentials.empty()) {
@@ -333,10 +355,12 @@ int main(int argc, char ** argv)
         }
     }
 
+    server.setReactors(httpReactors, !unpinnedHttpReactors);
+    server.setCompression(httpCompressMinBytes, httpCompressLevel);
     server.httpBoundAddress = server.bindTcp(httpListenPort, httpListenHost);
     server.router.addAutodocRoute("/autodoc", "/v1/help", "autodoc");
     server.threadPool->ensureThreads(numThreads);
-    server.httpEndpoint->allowAllOrigins();
+    server.allowAllOrigins();
 
     server.start();
 
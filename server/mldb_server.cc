@@ -13,15 +13,24 @@
 #include "mldb/rest/asio_peer_server.h"
 #include "mldb/rest/standalone_peer_server.h"
 #include "mldb/rest/collection_config_store.h"
+#include "mldb/rest/entity_restorer.h"
 #include "mldb/rest/http_rest_endpoint.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/rest/in_process_rest_connection.h"
+#include "mldb/rest/latency_metrics.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/engine/static_content_handler.h"
 #include "mldb/server/plugin_manifest.h"
 #include "mldb/builtin/plugin_resource.h"
 #include "mldb/sql/sql_expression.h"
+#include "mldb/sql/query_explain.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/base/memory_arena.h"
+#include "mldb/base/resource_usage.h"
+#include "mldb/rest/opstats/process_stats.h"
 #include <signal.h>
+#include <thread>
 
 #include "mldb/engine/dataset_collection.h"
 #include "mldb/engine/plugin_collection.h"
@@ -36,8 +45,10 @@
 #include "mldb/engine/analytics.h"
 #include "mldb/types/meta_value_description.h"
 #include "mldb/arch/simd.h"
+#include "mldb/arch/profile_scope.h"
 #include "mldb/utils/log.h"
 #include "mldb/builtin/shared_library_plugin.h"
+#include "mldb/builtin/joined_dataset.h"
 #include "mldb/types/any_impl.h"
 
 using namespace std;
@@ -80,6 +91,97 @@ std::shared_ptr<TypeClassCollection>
 createTypeClassCollection(MldbEngine * engine, RestRouteManager & routeManager);
 
 
+/** Return the number of parsed statements to keep in the statement cache.
+    This is read from the MLDB_STATEMENT_CACHE_SIZE environment variable,
+    and zero disables the cache.
+*/
+static size_t getStatementCacheSize()
+{
+    const char * size = getenv("MLDB_STATEMENT_CACHE_SIZE");
+    if (!size || !*size)
+        return 256;
+    char * end = nullptr;
+    unsigned long long result = strtoull(size, &end, 10);
+    if (*end != 0) {
+        throw AnnotatedException
+            (400, "MLDB_STATEMENT_CACHE_SIZE must be a number of statements",
+             "value", string(size));
+    }
+    return result;
+}
+
+/** Return the number of bytes of query results to keep in the query
+    result cache.  This is read from the MLDB_QUERY_RESULT_CACHE_BYTES
+    environment variable; zero (the default) disables the cache.
+*/
+static size_t getQueryResultCacheBytes()
+{
+    const char * size = getenv("MLDB_QUERY_RESULT_CACHE_BYTES");
+    if (!size || !*size)
+        return 0;
+    char * end = nullptr;
+    unsigned long long result = strtoull(size, &end, 10);
+    if (*end != 0) {
+        throw AnnotatedException
+            (400, "MLDB_QUERY_RESULT_CACHE_BYTES must be a number of bytes",
+             "value", string(size));
+    }
+    return result;
+}
+
+/** Return the number of seconds for which a cached query result may be
+    reused, from the MLDB_QUERY_RESULT_CACHE_MAX_AGE environment variable.
+    The default is 300 (5 minutes).
+*/
+static double getQueryResultCacheMaxAge()
+{
+    const char * age = getenv("MLDB_QUERY_RESULT_CACHE_MAX_AGE");
+    if (!age || !*age)
+        return 300;
+    char * end = nullptr;
+    double result = strtod(age, &end);
+    if (*end != 0 || result < 0) {
+        throw AnnotatedException
+            (400, "MLDB_QUERY_RESULT_CACHE_MAX_AGE must be a number of seconds",
+             "value", string(age));
+    }
+    return result;
+}
+
+/** Return the number of seconds over which a query is slow enough to be
+    logged, from the MLDB_SLOW_QUERY_SECONDS environment variable.  The
+    default is 10; a negative number turns the logging off.
+*/
+static double getSlowQuerySeconds()
+{
+    const char * seconds = getenv("MLDB_SLOW_QUERY_SECONDS");
+    if (!seconds || !*seconds)
+        return 10;
+    char * end = nullptr;
+    double result = strtod(seconds, &end);
+    if (*end != 0) {
+        throw AnnotatedException
+            (400, "MLDB_SLOW_QUERY_SECONDS must be a number of seconds",
+             "value", string(seconds));
+    }
+    return result;
+}
+
+/** Return the key under which a query is cached.  Whitespace around the
+    statement doesn't change its meaning.  Inside the statement it may be
+    part of a string literal, so it's kept.
+*/
+static Utf8String getQueryCacheKey(const Utf8String & query)
+{
+    std::string key = query.rawString();
+    size_t start = key.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos)
+        key.clear();
+    else key = key.substr(start, key.find_last_not_of(" \t\r\n") - start + 1);
+    return Utf8String(std::move(key));
+}
+
+
 /*****************************************************************************/
 /* MLDB SERVER                                                               */
 /*****************************************************************************/
@@ -93,11 +195,24 @@ MldbServer(const std::string & serviceName,
     : ServicePeer(serviceName, "MLDB", "global", enableAccessLog),
       EventRecorder(serviceName, std::make_shared<NullEventService>()),
       httpBaseUrl(httpBaseUrl), versionNode(nullptr),
-      logger(getMldbLog<MldbServer>())
+      logger(getMldbLog<MldbServer>()),
+      statementCache(getStatementCacheSize()),
+      resultCache(getQueryResultCacheBytes(), getQueryResultCacheMaxAge()),
+      slowQuerySeconds(getSlowQuerySeconds())
 {
     // Don't allow URIs without a scheme
     setGlobalAcceptUrisWithoutScheme(false);
 
+    // Limits on concurrent requests, like "/v1/query=4:16:10"
+    const char * admissionLimits = getenv("MLDB_ADMISSION_LIMITS");
+    if (admissionLimits)
+        admission.parseLimits(admissionLimits);
+
+    // Limits shared by procedure runs, like "4:16:64G"
+    const char * runLimits = getenv("MLDB_PROCEDURE_RUN_LIMITS");
+    if (runLimits)
+        runScheduler.parseLimits(runLimits);
+
     addRoutes();
 
     if (etcdUri != "")
@@ -193,6 +308,199 @@ initRoutes()
                            this,
                            RestParam<std::string>("type", "The type to look up"));
 
+    addRouteSyncJsonReturn(versionNode, "/threadPool", {"GET"},
+                           "Get statistics of the thread pool",
+                           "Threads, waiting jobs of each priority and "
+                           "work stealing counters",
+                           &MldbServer::getThreadPoolStats,
+                           this);
+
+    addRouteSyncJsonReturn(versionNode, "/queryCache", {"GET"},
+                           "Get statistics of the SQL statement and query "
+                           "result caches",
+                           "Size, capacity, hits, misses and evictions",
+                           &MldbServer::getQueryCacheStats,
+                           this);
+
+    addRouteSync(versionNode, "/queryCache/results", {"PUT"},
+                 "Configure the query result cache",
+                 &MldbServer::configureQueryResultCache,
+                 this,
+                 JsonParam<uint64_t>("capacityBytes",
+                                     "Memory used by cached query results; "
+                                     "zero disables the cache"),
+                 JsonParamDefault<double>("maxAgeSeconds",
+                                          "Time after which a cached result "
+                                          "is no longer used",
+                                          300));
+
+    addRouteSyncJsonReturn(versionNode, "/admission", {"GET"},
+                           "Get the admission limits of routes",
+                           "Limits, running and waiting requests and "
+                           "rejections of each limited route",
+                           &AdmissionControl::getStats,
+                           &admission);
+
+    addRouteSync(versionNode, "/admission", {"PUT"},
+                 "Limit the number of concurrent requests to a route",
+                 &MldbServer::setAdmissionLimits,
+                 this,
+                 JsonParam<std::string>("route",
+                                        "Route prefix to limit, where * "
+                                        "matches any one path segment"),
+                 JsonParamDefault<int>("maxConcurrent",
+                                       "Number of requests that may run at "
+                                       "the same time", 1),
+                 JsonParamDefault<int>("maxQueued",
+                                       "Number of requests that may wait "
+                                       "for a running one to finish", 0),
+                 JsonParamDefault<double>("maxWaitSeconds",
+                                          "Longest time that a request "
+                                          "waits before it is rejected",
+                                          1.0));
+
+    addRouteSync(versionNode, "/admission", {"DELETE"},
+                 "Remove the limit on concurrent requests to a route",
+                 &MldbServer::removeAdmissionLimits,
+                 this,
+                 RestParam<std::string>("route", "Route prefix to unlimit"));
+
+    addRouteSyncJsonReturn(versionNode, "/procedureRuns", {"GET"},
+                           "Get the scheduling of procedure runs",
+                           "Limits, reserved resources and the runs that "
+                           "are executing and queued",
+                           &ProcedureRunScheduler::getStatus,
+                           &runScheduler);
+
+    addRouteSync(versionNode, "/procedureRuns", {"PUT"},
+                 "Set the limits shared by procedure runs",
+                 &MldbServer::setProcedureRunLimits,
+                 this,
+                 JsonParamDefault<int>("maxConcurrentRuns",
+                                       "Number of runs that may execute at "
+                                       "the same time, or -1 for no limit",
+                                       -1),
+                 JsonParamDefault<double>("cpus",
+                                          "CPUs that executing runs may "
+                                          "reserve, or -1 for the number "
+                                          "of CPUs of the machine", -1),
+                 JsonParamDefault<uint64_t>("memoryBytes",
+                                            "Memory that executing runs may "
+                                            "reserve, or 0 for no limit",
+                                            0));
+
+    RestRequestRouter::OnProcessRequest handleMetrics
+        = [=] (RestConnection & connection,
+               const RestRequest & request,
+               const RestRequestParsingContext & context) {
+        connection.sendResponse(200, getLatencyMetricsText(),
+                                LATENCY_METRICS_CONTENT_TYPE);
+        return RestRequestRouter::MR_YES;
+    };
+
+    versionNode.addRoute("/metrics", "GET",
+                         "Latency histograms of REST routes, procedure runs, "
+                         "function calls and dataset queries, in the "
+                         "Prometheus text format",
+                         handleMetrics,
+                         Json::Value());
+
+    RestRequestRouter::OnProcessRequest handleProfile
+        = [=] (RestConnection & connection,
+               const RestRequest & request,
+               const RestRequestParsingContext & context) {
+        double seconds = 10.0;
+        if (request.params.hasValue("seconds")) {
+            std::string str = request.params.getValue("seconds").rawString();
+            char * end = nullptr;
+            seconds = strtod(str.c_str(), &end);
+            if (str.empty() || *end != 0)
+                seconds = -1;
+        }
+        std::string format = "json";
+        if (request.params.hasValue("format"))
+            format = request.params.getValue("format").rawString();
+
+        if (!(seconds > 0 && seconds <= 300)) {
+            connection.sendErrorResponse
+                (400, "Profiling seconds must be greater than zero and at "
+                 "most 300", "application/json");
+            return RestRequestRouter::MR_YES;
+        }
+        if (format != "json" && format != "folded") {
+            connection.sendErrorResponse
+                (400, "Profile format must be 'json' or 'folded'",
+                 "application/json");
+            return RestRequestRouter::MR_YES;
+        }
+        if (!startProfiling()) {
+            connection.sendErrorResponse
+                (409, "A profiling session is already running",
+                 "application/json");
+            return RestRequestRouter::MR_YES;
+        }
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        ProfileReport report = stopProfiling();
+
+        if (format == "folded") {
+            connection.sendResponse(200, report.folded(), "text/plain");
+            return RestRequestRouter::MR_YES;
+        }
+
+        Json::Value result;
+        result["seconds"] = report.seconds;
+        result["numThreads"] = report.numThreads;
+        result["points"] = Json::Value(Json::arrayValue);
+        for (auto & point: report.points) {
+            Json::Value entry;
+            entry["name"] = point.name;
+            entry["count"] = point.count;
+            entry["totalSeconds"] = point.totalSeconds;
+            entry["selfSeconds"] = point.selfSeconds;
+            result["points"].append(entry);
+        }
+        result["stacks"] = Json::Value(Json::arrayValue);
+        for (auto & stack: report.stacks) {
+            Json::Value entry;
+            for (auto & name: stack.names)
+                entry["names"].append(name);
+            entry["count"] = stack.count;
+            entry["totalSeconds"] = stack.totalSeconds;
+            entry["selfSeconds"] = stack.selfSeconds;
+            result["stacks"].append(entry);
+        }
+        connection.sendResponse(200, result);
+        return RestRequestRouter::MR_YES;
+    };
+
+    versionNode.addRoute("/profile", "GET",
+                         "Time the instrumented hot paths of every thread "
+                         "for a number of seconds, and return the totals "
+                         "for each point and stack",
+                         handleProfile,
+                         Json::Value());
+
+    RestRequestRouter::OnProcessRequest handleReady
+        = [=] (RestConnection & connection,
+               const RestRequest & request,
+               const RestRequestParsingContext & context) {
+        EntityRestorerStatus status;
+        if (restorer)
+            status = restorer->getStatus();
+        else status.ready = !!datasets;
+        connection.sendResponse(status.ready ? 200 : 503,
+                                jsonEncode(status));
+        return RestRequestRouter::MR_YES;
+    };
+
+    versionNode.addRoute("/ready", "GET",
+                         "Whether the entities stored before the last "
+                         "restart have all been restored, and the progress "
+                         "of each one",
+                         handleReady,
+                         Json::Value());
+
     versionNode.addRoute("/shutdown", "POST", "Shutdown the service",
                          handleShutdown,
                          Json::Value());
@@ -209,7 +517,9 @@ initRoutes()
             HybridParamDefault<Utf8String>("q", queryStringDef, ""),
             PassConnectionId(),
             HybridParamDefault<std::string>("format",
-                                            "Format of output",
+                                            "Format of output; 'jsonl' and "
+                                            "'csv' are streamed as the "
+                                            "query runs",
                                             "full"),
             HybridParamDefault<bool>("headers",
                                      "Do we include headers on table format",
@@ -222,6 +532,26 @@ initRoutes()
                                      false),
             HybridParamDefault<bool>("sortColumns",
                                      "Do we sort the column names",
+                                     false),
+            HybridParamDefault<bool>("explain",
+                                     "Run the query, but return its plan "
+                                     "with the time and rows of each step "
+                                     "rather than its output",
+                                     false),
+            HybridParamDefault<int>("maxParallelism",
+                                    "Maximum number of threads the query "
+                                    "may use at once; -1 means as many as "
+                                    "there are CPUs",
+                                    -1),
+            HybridParamDefault<std::string>("priority",
+                                            "Priority of the query: "
+                                            "'interactive' (default) or "
+                                            "'batch'",
+                                            "interactive"),
+            HybridParamDefault<bool>("resourceUsage",
+                                     "Return the CPU time, memory, rows "
+                                     "scanned and bytes read of the query "
+                                     "in the X-MLDB-Resource-Usage header",
                                      false));
 
         addRouteAsync(
@@ -264,19 +594,115 @@ runHttpQuery(const Utf8String& query,
              bool createHeaders,
              bool rowNames,
              bool rowHashes,
-             bool sortColumns) const
+             bool sortColumns,
+             bool explain,
+             int maxParallelism,
+             const std::string & priority,
+             bool resourceUsage) const
 {
-    auto stm = SelectStatement::parse(query.rawString());
+    if (maxParallelism != -1 && maxParallelism < 1)
+        throw AnnotatedException(400, "maxParallelism must be -1 or at least 1",
+                                 "maxParallelism", maxParallelism);
+    if (priority != "interactive" && priority != "batch")
+        throw AnnotatedException(400, "Unknown 'priority' for query: got "
+                                 + priority + ", accepted are 'interactive' "
+                                 "or 'batch'");
+
+    auto stm = getStatement(query);
     SqlExpressionMldbScope mldbContext(this);
+    ParallelismScope parallelism(maxParallelism,
+                                 priority == "batch"
+                                 ? ParallelPriority::BATCH
+                                 : ParallelPriority::INTERACTIVE);
+
+    // Temporary allocations of the query are given back when it's done
+    MemoryArena arena("query");
+    MemoryArenaScope arenaScope(&arena);
+
+    // So are the resources used by all of the threads working on it
+    Date started = Date::now();
+    auto usage = std::make_shared<ResourceUsage>("query");
+    ResourceUsageScope usageScope(usage.get());
+
+    auto getResources = [&] ()
+        {
+            usageScope.flush();
+            Json::Value result = jsonEncode(usage->stats());
+            result["seconds"] = Date::now().secondsSince(started);
+            result["memory"] = jsonEncode(arena.stats());
+            return result;
+        };
+
+    auto finishQuery = [&] (const Json::Value & resources)
+        {
+            double seconds = resources["seconds"].asDouble();
+            if (slowQuerySeconds >= 0 && seconds > slowQuerySeconds) {
+                WARNING_MSG(logger) << "slow query took " << seconds
+                                    << "s: " << query << " resources "
+                                    << resources.toStringNoNewLine();
+            }
+        };
+
+    if (explain) {
+        auto plan = std::make_shared<QueryExplainNode>("Query");
+        plan->details["query"] = query;
+        {
+            QueryExplainScope explainScope(plan);
+            QueryExplainTimer timer(plan.get());
+            plan->rowsOut
+                = queryFromStatement(*stm, mldbContext, nullptr /*onProgress*/)
+                .size();
+        }
+        Json::Value resources = getResources();
+        plan->details["memory"] = resources["memory"];
+        plan->details["resources"] = resources;
+        connection.sendResponse(200, plan->toJson());
+        finishQuery(resources);
+        return;
+    }
+
+    if (isStreamingQueryFormat(format)) {
+        // Send the rows as they come out of the query, rather than
+        // collecting them all first
+        auto runQuery = [&] (std::function<bool (const RowPath &, RowValue &)> & onRow)
+            {
+                std::function<bool (Path &, ExpressionValue &)> onOutput
+                    = [&] (Path & rowName, ExpressionValue & val)
+                    {
+                        RowValue row;
+                        val.mergeToRowDestructive(row);
+                        return onRow(rowName, row);
+                    };
+                return queryFromStatement(onOutput, *stm, mldbContext);
+            };
+
+        // The headers have gone before we know what was used, so
+        // resourceUsage doesn't apply
+        MLDB::runHttpQueryStreaming(runQuery,
+                                    connection, format, createHeaders,
+                                    rowNames, rowHashes, sortColumns);
+        finishQuery(getResources());
+        return;
+    }
 
-    auto runQuery = [&] ()
+    auto run = [&] ()
         {
-            return queryFromStatement(stm, mldbContext, nullptr /*onProgress*/);
+            return queryFromStatement(*stm, mldbContext,
+                                      nullptr /*onProgress*/);
         };
+    auto output = resultCache.getOrRun(getQueryCacheKey(query), *this, run);
+
+    Json::Value resources = getResources();
+    RestParams headers;
+    if (resourceUsage) {
+        headers.emplace_back("X-MLDB-Resource-Usage",
+                             resources.toStringNoNewLine());
+    }
 
-    MLDB::runHttpQuery(runQuery,
+    MLDB::runHttpQuery([&] () { return *output; },
                        connection, format, createHeaders,
-                       rowNames, rowHashes, sortColumns);
+                       rowNames, rowHashes, sortColumns, headers);
+    finishQuery(resources);
 }
 
 void
@@ -315,10 +741,121 @@ std::vector<MatrixNamedRow>
 MldbServer::
 query(const Utf8String& query) const
 {
-    auto stm = SelectStatement::parse(query.rawString());
+    auto stm = getStatement(query);
     SqlExpressionMldbScope mldbContext(this);
 
-    return queryFromStatement(stm, mldbContext, nullptr /*onProgress*/);
+    return queryFromStatement(*stm, mldbContext, nullptr /*onProgress*/);
+}
+
+std::shared_ptr<const SelectStatement>
+MldbServer::
+getStatement(const Utf8String & query) const
+{
+    auto parse = [&] ()
+        {
+            return std::make_shared<const SelectStatement>
+                (SelectStatement::parse(query.rawString()));
+        };
+
+    return statementCache.getOrCreate(getQueryCacheKey(query), parse);
+}
+
+Json::Value
+MldbServer::
+getQueryCacheStats()
+{
+    LruCacheStats stats = statementCache.stats();
+    Json::Value result;
+    result["statements"]["size"] = stats.size;
+    result["statements"]["capacity"] = stats.capacity;
+    result["statements"]["hits"] = stats.hits;
+    result["statements"]["misses"] = stats.misses;
+    result["statements"]["evictions"] = stats.evictions;
+
+    QueryResultCacheStats results = resultCache.stats();
+    result["results"]["entries"] = results.entries;
+    result["results"]["bytes"] = results.bytes;
+    result["results"]["capacityBytes"] = results.capacityBytes;
+    result["results"]["maxAgeSeconds"] = results.maxAgeSeconds;
+    result["results"]["hits"] = results.hits;
+    result["results"]["misses"] = results.misses;
+    result["results"]["invalidations"] = results.invalidations;
+    result["results"]["evictions"] = results.evictions;
+    result["results"]["uncacheable"] = results.uncacheable;
+    result["results"]["tooLarge"] = results.tooLarge;
+    uint64_t lookups = results.hits + results.misses;
+    result["results"]["hitRate"] = lookups ? 1.0 * results.hits / lookups : 0.0;
+
+    JoinCacheStats joins = getJoinCacheStats();
+    result["joins"]["entries"] = joins.entries;
+    result["joins"]["sideEntries"] = joins.sideEntries;
+    result["joins"]["hits"] = joins.hits;
+    result["joins"]["incremental"] = joins.incremental;
+    result["joins"]["diskHits"] = joins.diskHits;
+    result["joins"]["misses"] = joins.misses;
+    result["joins"]["uncacheable"] = joins.uncacheable;
+    return result;
+}
+
+Json::Value
+MldbServer::
+getThreadPoolStats() const
+{
+    const ThreadPool & pool = ThreadPool::instance();
+    Json::Value result;
+    result["numThreads"] = pool.numThreads();
+    result["jobsRunning"] = pool.jobsRunning();
+    result["queued"]["interactive"]
+        = pool.jobsQueued(ParallelPriority::INTERACTIVE);
+    result["queued"]["batch"]
+        = pool.jobsQueued(ParallelPriority::BATCH);
+    result["jobsStolen"] = pool.jobsStolen();
+    result["jobsStolenRemote"] = pool.jobsStolenRemote();
+    result["jobsRunLocally"] = pool.jobsRunLocally();
+    result["jobsWithFullQueue"] = pool.jobsWithFullQueue();
+    return result;
+}
+
+void
+MldbServer::
+configureQueryResultCache(uint64_t capacityBytes, double maxAgeSeconds)
+{
+    if (maxAgeSeconds < 0)
+        throw AnnotatedException(400, "maxAgeSeconds must not be negative",
+                                 "maxAgeSeconds", maxAgeSeconds);
+    resultCache.configure(capacityBytes, maxAgeSeconds);
+}
+
+void
+MldbServer::
+setAdmissionLimits(const std::string & route,
+                   int maxConcurrent, int maxQueued, double maxWaitSeconds)
+{
+    AdmissionLimits limits;
+    limits.maxConcurrent = maxConcurrent;
+    limits.maxQueued = maxQueued;
+    limits.maxWaitSeconds = maxWaitSeconds;
+    admission.setLimits(route, limits);
+}
+
+void
+MldbServer::
+removeAdmissionLimits(const std::string & route)
+{
+    if (!admission.removeLimits(route))
+        throw AnnotatedException(404, "route has no admission limits",
+                                 "route", route);
+}
+
+void
+MldbServer::
+setProcedureRunLimits(int maxConcurrentRuns, double cpus, uint64_t memoryBytes)
+{
+    ProcedureRunLimits limits;
+    limits.maxConcurrentRuns = maxConcurrentRuns;
+    limits.cpus = cpus;
+    limits.memoryBytes = memoryBytes;
+    runScheduler.setLimits(limits);
 }
 
 Json::Value
@@ -376,11 +913,65 @@ initCollections(std::string credentialsPath,
     credentials = createCredentialCollection(this, *routeManager, makeCredentialStore());
     types = createTypeClassCollection(this, *routeManager);
 
-    plugins->loadConfig();
-    datasets->loadConfig();
-    procedures->loadConfig();
-    functions->loadConfig();
-    sensors->loadConfig();
+    // Entities are persisted under this directory, one subdirectory per
+    // collection, and restored from there when MLDB restarts
+    const char * entityConfigPath = getenv("MLDB_ENTITY_CONFIG_PATH");
+    if (entityConfigPath && *entityConfigPath) {
+        std::string path = entityConfigPath;
+        if (path.find("://") == string::npos)
+            path = "file://" + path;
+        // Above zero, changes are batched and written behind
+        double flushSeconds = 0.0;
+        if (getenv("MLDB_ENTITY_CONFIG_FLUSH_SECONDS"))
+            flushSeconds = std::stod(getenv("MLDB_ENTITY_CONFIG_FLUSH_SECONDS"));
+        auto attach = [&] (auto & collection) {
+            collection->attachConfig
+                (std::make_shared<S3CollectionConfigStore>
+                 (path + "/" + collection->nounPlural.rawString(),
+                  flushSeconds));
+        };
+        attach(plugins);
+        attach(datasets);
+        attach(procedures);
+        attach(functions);
+    }
+
+    int restoreConcurrency = 8;
+    if (getenv("MLDB_RESTORE_CONCURRENCY"))
+        restoreConcurrency = std::stoi(getenv("MLDB_RESTORE_CONCURRENCY"));
+
+    // Datasets and functions that are rarely used don't need to take up
+    // memory until they are
+    const char * lazyEntities = getenv("MLDB_LAZY_ENTITIES");
+    if (lazyEntities && string(lazyEntities) == "1") {
+        datasets->lazyByDefault = true;
+        functions->lazyByDefault = true;
+    }
+
+    // Plugins come first, as they may provide the types of the others
+    restorer = std::make_shared<EntityRestorer>(restoreConcurrency);
+    plugins->addToRestorer(*restorer, 0);
+    datasets->addToRestorer(*restorer, 1);
+    procedures->addToRestorer(*restorer, 1);
+    functions->addToRestorer(*restorer, 1);
+    sensors->addToRestorer(*restorer, 1);
+    restorer->start();
+
+    // In the background, requests are served as soon as we return, and
+    // entities appear as they are loaded
+    const char * restoreInBackground = getenv("MLDB_RESTORE_IN_BACKGROUND");
+    if (!restoreInBackground || string(restoreInBackground) != "1")
+        restorer->wait();
+
+    const char * unloadSeconds = getenv("MLDB_LAZY_UNLOAD_SECONDS");
+    if (unloadSeconds && *unloadSeconds) {
+        double idleSeconds = std::stod(unloadSeconds);
+        uint64_t rssBytes = 0;
+        if (getenv("MLDB_LAZY_UNLOAD_RSS_BYTES"))
+            rssBytes = std::stoull(getenv("MLDB_LAZY_UNLOAD_RSS_BYTES"));
+        lazyUnloader = std::thread([=] ()
+                                   { runLazyUnloader(idleSeconds, rssBytes); });
+    }
 
     if (false) {
         logRequest = [&] (const HttpRestConnection & conn, const RestRequest & req)
@@ -423,10 +1014,24 @@ void
 MldbServer::
 shutdown()
 {
-    httpEndpoint->closePeer();
+    closeEndpoints();
 
     ServicePeer::shutdown();
 
+    // Don't start restoring anything else; what is loading is cancelled
+    // by clearing its collection below
+    if (restorer)
+        restorer->cancel();
+
+    if (lazyUnloader.joinable()) {
+        {
+            std::unique_lock<std::mutex> guard(lazyUnloaderMutex);
+            lazyUnloaderShutdown = true;
+        }
+        lazyUnloaderWakeup.notify_all();
+        lazyUnloader.join();
+    }
+
     // Clear first, so that anything running async will not encounter a
     // dangling pointer in this object while it's waiting to get to a
     // cancellation point.
@@ -441,6 +1046,8 @@ shutdown()
     if (plugins)
         plugins->clear();
 
+    restorer.reset();
+
     // Now we can clear things
     datasets.reset();
     procedures.reset();
@@ -458,6 +1065,27 @@ shutdown()
     recordHit("serviceStopped");
 }
 
+void
+MldbServer::
+runLazyUnloader(double idleSeconds, uint64_t rssBytes)
+{
+    // Check often enough that nothing stays much longer than idleSeconds
+    auto interval = std::chrono::duration<double>
+        (std::min(std::max(idleSeconds / 4, 1.0), 60.0));
+
+    std::unique_lock<std::mutex> guard(lazyUnloaderMutex);
+    while (!lazyUnloaderWakeup.wait_for(guard, interval,
+                                        [&] () { return lazyUnloaderShutdown; })) {
+        if (rssBytes && ProcessStats().residentMem < rssBytes)
+            continue;
+        size_t numUnloaded = datasets->unloadIdle(idleSeconds)
+            + functions->unloadIdle(idleSeconds);
+        if (numUnloaded)
+            INFO_MSG(logger) << "unloaded " << numUnloaded
+                             << " idle lazily loaded entities";
+    }
+}
+
 static bool endsWith(const std::string & str,
                      const std::string & what)
 {
@@ -720,6 +1348,18 @@ createPluginSync(PolyConfig config,
                                            overwrite);
 }
 
+uint64_t
+MldbServer::
+getCatalogGeneration() const
+{
+    uint64_t result = 0;
+    if (datasets)
+        result += datasets->getGeneration();
+    if (functions)
+        result += functions->getGeneration();
+    return result;
+}
+
 std::shared_ptr<Plugin>
 MldbServer::
 tryGetPlugin(const Utf8String & pluginName) const
@@ -838,7 +1478,7 @@ std::shared_ptr<ProcedureRunCollection>
 MldbServer::
 createProcedureRunCollection(Procedure * owner)
 {
-    return std::make_shared<ProcedureRunCollection>(this, owner);
+    return std::make_shared<ProcedureRunCollection>(this, owner, &runScheduler);
 }
 
 std::shared_ptr<Sensor>
@@ -15,6 +15,12 @@
 #include "mldb/types/string.h"
 #include "mldb/rest/event_service.h"
 #include "mldb/utils/log_fwd.h"
+#include "mldb/utils/lru_cache.h"
+#include "mldb/engine/query_result_cache.h"
+#include "mldb/engine/procedure_run_scheduler.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 
 namespace MLDB {
@@ -31,6 +37,7 @@ struct FunctionCollection;
 struct SensorCollection;
 struct CredentialRuleCollection;
 struct TypeClassCollection;
+struct EntityRestorer;
 
 struct Plugin;
 struct Dataset;
@@ -38,6 +45,7 @@ struct Procedure;
 struct Function;
 struct Sensor;
 struct CredentialRule;
+struct SelectStatement;
 
 struct MatrixNamedRow;
 
@@ -103,6 +111,10 @@ struct MldbServer: public MldbEngine, public ServicePeer, public EventRecorder {
 
     std::shared_ptr<RestRouteManager> routeManager;
 
+    /// Decides when procedure runs may start.  It's declared before the
+    /// collections so that it outlives the runs.
+    ProcedureRunScheduler runScheduler;
+
     std::shared_ptr<PluginCollection> plugins;
     std::shared_ptr<DatasetCollection> datasets;
     std::shared_ptr<ProcedureCollection> procedures;
@@ -111,11 +123,16 @@ struct MldbServer: public MldbEngine, public ServicePeer, public EventRecorder {
     std::shared_ptr<TypeClassCollection> types;
     std::shared_ptr<SensorCollection> sensors;
 
+    /// Restores the entities of the collections from their stored
+    /// configuration when the server starts
+    std::shared_ptr<EntityRestorer> restorer;
+
     /** Parse and perform an SQL query. */
     std::vector<MatrixNamedRow> query(const Utf8String& query) const;
 
     /** Parse and perform an SQL query, returning the results
-        on the given HTTP connection.
+        on the given HTTP connection.  If explain is true, the plan of
+        the query is returned instead (see query_explain.h).
     */
     void runHttpQuery(const Utf8String& query,
                       RestConnection & connection,
@@ -123,7 +140,53 @@ struct MldbServer: public MldbEngine, public ServicePeer, public EventRecorder {
                       bool createHeaders,
                       bool rowNames,
                       bool rowHashes,
-                      bool sortColumns) const;
+                      bool sortColumns,
+                      bool explain = false,
+                      int maxParallelism = -1,
+                      const std::string & priority = "interactive",
+                      bool resourceUsage = false) const;
+
+    /** Return the parsed form of the given SQL query, from the statement
+        cache if it has already been parsed.  The statement is shared
+        between all of the queries that use it and must not be modified.
+    */
+    std::shared_ptr<const SelectStatement>
+    getStatement(const Utf8String & query) const;
+
+    /** Return the statistics of the statement cache and the query result
+        cache, for the /v1/queryCache route.
+    */
+    Json::Value getQueryCacheStats();
+
+    /** Return the queue depths and work stealing statistics of the
+        thread pool that runs queries, procedures and functions, for the
+        /v1/threadPool route.
+    */
+    Json::Value getThreadPoolStats() const;
+
+    /** Change the capacity in bytes and the maximum age in seconds of the
+        query result cache.  A capacity of zero disables it.
+    */
+    void configureQueryResultCache(uint64_t capacityBytes,
+                                   double maxAgeSeconds);
+
+    /** Set the admission limits of the given route, for the PUT
+        /v1/admission route.
+    */
+    void setAdmissionLimits(const std::string & route,
+                            int maxConcurrent, int maxQueued,
+                            double maxWaitSeconds);
+
+    /** Remove the admission limits of the given route, for the DELETE
+        /v1/admission route.
+    */
+    void removeAdmissionLimits(const std::string & route);
+
+    /** Set the limits shared by procedure runs, for the PUT
+        /v1/procedureRuns route.
+    */
+    void setProcedureRunLimits(int maxConcurrentRuns, double cpus,
+                               uint64_t memoryBytes);
 
     /** Redirect POST request as a GET with body.  
         This is for client that do not support GET with body.
@@ -271,6 +334,9 @@ struct MldbServer: public MldbEngine, public ServicePeer, public EventRecorder {
     
     virtual std::shared_ptr<Sensor>
     getSensor(const Utf8String & sensorName) const override;
+
+    virtual uint64_t getCatalogGeneration() const override;
+
 private:
     void preInit();
     bool initRoutes();
@@ -281,6 +347,29 @@ private:
     RestRequestRouter * versionNode;
     std::string cacheDirectory_;
     std::shared_ptr<spdlog::logger> logger;
+
+    /// Parsed statements, keyed by their SQL text with surrounding
+    /// whitespace removed
+    mutable LruCache<Utf8String, std::shared_ptr<const SelectStatement> >
+        statementCache;
+
+    /// Results of queries sent to /v1/query, keyed like statementCache
+    mutable QueryResultCache resultCache;
+
+    /// Queries that take longer than this many seconds are logged with
+    /// the resources they used.  Negative means none are.
+    double slowQuerySeconds;
+
+    /** Unloads the datasets and functions that were loaded on first use
+        once they have been idle for idleSeconds, whenever the resident
+        memory is over rssBytes.  Runs until shutdown.
+    */
+    void runLazyUnloader(double idleSeconds, uint64_t rssBytes);
+
+    std::thread lazyUnloader;
+    std::mutex lazyUnloaderMutex;
+    std::condition_variable lazyUnloaderWakeup;
+    bool lazyUnloaderShutdown = false;
 };
 
 } // namespace MLDB
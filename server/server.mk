@@ -21,6 +21,7 @@ LIBMLDB_LINK:= \
 	mldb_core \
 	mldb_engine \
 	rest \
+	opstats \
 
 
 $(eval $(call library,mldb,$(LIBMLDB_SOURCES),$(LIBMLDB_LINK)))
@@ -0,0 +1,749 @@
+/** arrow_writer.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Writer for the Apache Arrow IPC formats.  The metadata of the format is
+    encoded as FlatBuffers, which are built here directly, using the
+    schemas in Schema.fbs, Message.fbs and File.fbs of the Arrow project.
+*/
+
+#include "mldb/sql/arrow_writer.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/date.h"
+#include "mldb/types/path.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+const char * arrowTypeName(ArrowType type)
+{
+    switch (type) {
+    case ArrowType::NONE:      return "null";
+    case ArrowType::INT64:     return "int64";
+    case ArrowType::FLOAT64:   return "double";
+    case ArrowType::TIMESTAMP: return "timestamp[us, tz=UTC]";
+    case ArrowType::UTF8:      return "string";
+    case ArrowType::BINARY:    return "binary";
+    }
+    throw MLDB::Exception("Unknown Arrow type");
+}
+
+ArrowType widenArrowType(ArrowType type, const CellValue & value)
+{
+    ArrowType valueType;
+    switch (value.cellType()) {
+    case CellValue::EMPTY:
+        return type;
+    case CellValue::INTEGER:
+        valueType = value.isInt64() ? ArrowType::INT64 : ArrowType::FLOAT64;
+        break;
+    case CellValue::FLOAT:
+        valueType = ArrowType::FLOAT64;
+        break;
+    case CellValue::TIMESTAMP:
+        valueType = ArrowType::TIMESTAMP;
+        break;
+    case CellValue::BLOB:
+        valueType = ArrowType::BINARY;
+        break;
+    default:
+        valueType = ArrowType::UTF8;
+    }
+
+    if (type == ArrowType::NONE || type == valueType)
+        return valueType;
+    if (type == ArrowType::BINARY || valueType == ArrowType::BINARY)
+        return ArrowType::BINARY;
+    if ((type == ArrowType::INT64 && valueType == ArrowType::FLOAT64)
+        || (type == ArrowType::FLOAT64 && valueType == ArrowType::INT64))
+        return ArrowType::FLOAT64;
+    return ArrowType::UTF8;
+}
+
+
+namespace {
+
+/*****************************************************************************/
+/* FLATBUFFER BUILDER                                                        */
+/*****************************************************************************/
+
+/** Minimal FlatBuffer builder.  As in the reference implementation, the
+    buffer is built from back to front so that every reference points
+    forwards, and objects are identified by their distance from the end.
+    Tables must be built one at a time, after their children.  Scalars
+    are written in host byte order, which must be little endian.
+*/
+
+struct FlatBufferBuilder {
+    typedef uint32_t Offset;
+
+    FlatBufferBuilder()
+        : buf(1024), head(buf.size())
+    {
+    }
+
+    size_t size() const
+    {
+        return buf.size() - head;
+    }
+
+    void reserve(size_t n)
+    {
+        if (head >= n)
+            return;
+        size_t used = size();
+        std::vector<char> newBuf(std::max(buf.size() * 2, used + n));
+        std::copy(buf.begin() + head, buf.end(), newBuf.end() - used);
+        buf.swap(newBuf);
+        head = buf.size() - used;
+    }
+
+    void push(const void * data, size_t n)
+    {
+        reserve(n);
+        head -= n;
+        memcpy(buf.data() + head, data, n);
+    }
+
+    template<typename T>
+    void pushScalar(T val)
+    {
+        push(&val, sizeof(val));
+    }
+
+    void pad(size_t n)
+    {
+        reserve(n);
+        head -= n;
+        memset(buf.data() + head, 0, n);
+    }
+
+    /// Pad so that once extra more bytes are pushed, we're aligned
+    void align(size_t alignment, size_t extra = 0)
+    {
+        pad((alignment - (size() + extra) % alignment) % alignment);
+    }
+
+    void pushOffset(Offset target)
+    {
+        align(4);
+        pushScalar<uint32_t>(size() + 4 - target);
+    }
+
+    Offset createString(const std::string & str)
+    {
+        align(4, str.size() + 1);
+        pad(1);
+        push(str.data(), str.size());
+        pushScalar<uint32_t>(str.size());
+        return size();
+    }
+
+    Offset createOffsetVector(const std::vector<Offset> & offsets)
+    {
+        align(4, offsets.size() * 4);
+        for (auto it = offsets.rbegin();  it != offsets.rend();  ++it)
+            pushOffset(*it);
+        pushScalar<uint32_t>(offsets.size());
+        return size();
+    }
+
+    /// Vector of structs, which are all aligned to 8 bytes in Arrow
+    template<typename Struct>
+    Offset createStructVector(const std::vector<Struct> & structs)
+    {
+        static_assert(sizeof(Struct) % 8 == 0, "structs must be 8 aligned");
+        align(8, structs.size() * sizeof(Struct));
+        for (auto it = structs.rbegin();  it != structs.rend();  ++it)
+            push(&*it, sizeof(Struct));
+        pushScalar<uint32_t>(structs.size());
+        return size();
+    }
+
+    void startTable()
+    {
+        ExcAssert(!inTable);
+        inTable = true;
+        fields.clear();
+        tableStart = size();
+    }
+
+    template<typename T>
+    void addScalar(int field, T val)
+    {
+        align(sizeof(T));
+        pushScalar(val);
+        fields.emplace_back(field, size());
+    }
+
+    void addOffset(int field, Offset target)
+    {
+        pushOffset(target);
+        fields.emplace_back(field, size());
+    }
+
+    Offset endTable()
+    {
+        ExcAssert(inTable);
+        inTable = false;
+
+        // The table starts with the offset of its vtable, filled in below
+        align(4);
+        pushScalar<int32_t>(0);
+        Offset table = size();
+
+        int numFields = 0;
+        for (auto & f: fields)
+            numFields = std::max(numFields, f.first + 1);
+        std::vector<uint16_t> vtable(numFields, 0);
+        for (auto & f: fields)
+            vtable[f.first] = table - f.second;
+
+        for (auto it = vtable.rbegin();  it != vtable.rend();  ++it)
+            pushScalar<uint16_t>(*it);
+        pushScalar<uint16_t>(table - tableStart);
+        pushScalar<uint16_t>(4 + 2 * numFields);
+
+        int32_t vtableOffset = size() - table;
+        memcpy(buf.data() + buf.size() - table, &vtableOffset, 4);
+        return table;
+    }
+
+    /// Return the finished buffer, whose length is a multiple of 8
+    std::string finish(Offset root)
+    {
+        align(8, 4);
+        pushOffset(root);
+        return std::string(buf.data() + head, buf.data() + buf.size());
+    }
+
+private:
+    std::vector<char> buf;
+    size_t head;
+    bool inTable = false;
+    size_t tableStart = 0;
+    std::vector<std::pair<int, Offset> > fields;
+};
+
+
+/*****************************************************************************/
+/* ARROW METADATA                                                            */
+/*****************************************************************************/
+
+// Values of the enums and unions in the Arrow schemas
+enum {
+    METADATA_V5 = 4,
+
+    HEADER_SCHEMA = 1,
+    HEADER_RECORD_BATCH = 3,
+
+    TYPE_INT = 2,
+    TYPE_FLOATING_POINT = 3,
+    TYPE_BINARY = 4,
+    TYPE_UTF8 = 5,
+    TYPE_TIMESTAMP = 10,
+
+    PRECISION_DOUBLE = 2,
+    TIME_UNIT_MICROSECOND = 2
+};
+
+struct FieldNode {
+    int64_t length;
+    int64_t nullCount;
+};
+
+struct BufferRef {
+    int64_t offset;
+    int64_t length;
+};
+
+struct Block {
+    int64_t offset;
+    int32_t metaDataLength;
+    int32_t padding;
+    int64_t bodyLength;
+};
+
+typedef FlatBufferBuilder::Offset Offset;
+
+Offset buildSchema(FlatBufferBuilder & fbb,
+                   const std::vector<ArrowField> & fields)
+{
+    std::vector<Offset> fieldOffsets;
+    for (auto & f: fields) {
+        Offset name = fbb.createString(f.name.rawString());
+
+        uint8_t typeType;
+        Offset type;
+        switch (f.type) {
+        case ArrowType::INT64:
+            fbb.startTable();
+            fbb.addScalar<int32_t>(0, 64);       // bitWidth
+            fbb.addScalar<uint8_t>(1, 1);        // is_signed
+            type = fbb.endTable();
+            typeType = TYPE_INT;
+            break;
+        case ArrowType::FLOAT64:
+            fbb.startTable();
+            fbb.addScalar<int16_t>(0, PRECISION_DOUBLE);
+            type = fbb.endTable();
+            typeType = TYPE_FLOATING_POINT;
+            break;
+        case ArrowType::TIMESTAMP: {
+            Offset timezone = fbb.createString("UTC");
+            fbb.startTable();
+            fbb.addScalar<int16_t>(0, TIME_UNIT_MICROSECOND);
+            fbb.addOffset(1, timezone);
+            type = fbb.endTable();
+            typeType = TYPE_TIMESTAMP;
+            break;
+        }
+        case ArrowType::UTF8:
+            fbb.startTable();
+            type = fbb.endTable();
+            typeType = TYPE_UTF8;
+            break;
+        case ArrowType::BINARY:
+            fbb.startTable();
+            type = fbb.endTable();
+            typeType = TYPE_BINARY;
+            break;
+        default:
+            throw MLDB::Exception("Arrow field type was not chosen");
+        }
+
+        // Readers insist on the children being there, even if empty
+        Offset children = fbb.createOffsetVector({});
+
+        fbb.startTable();
+        fbb.addOffset(0, name);
+        fbb.addScalar<uint8_t>(1, 1);            // nullable
+        fbb.addScalar<uint8_t>(2, typeType);
+        fbb.addOffset(3, type);
+        fbb.addOffset(5, children);
+        fieldOffsets.push_back(fbb.endTable());
+    }
+
+    Offset fieldsVector = fbb.createOffsetVector(fieldOffsets);
+    fbb.startTable();
+    fbb.addScalar<int16_t>(0, 0);                // little endian
+    fbb.addOffset(1, fieldsVector);
+    return fbb.endTable();
+}
+
+/// Finish a Message whose header has been built in the builder
+std::string finishMessage(FlatBufferBuilder & fbb,
+                          uint8_t headerType, Offset header,
+                          int64_t bodyLength,
+                          const std::vector<std::pair<std::string, std::string> >
+                              & metadata = {})
+{
+    Offset metadataVector = 0;
+    if (!metadata.empty()) {
+        std::vector<Offset> keyValues;
+        for (auto & kv: metadata) {
+            Offset key = fbb.createString(kv.first);
+            Offset value = fbb.createString(kv.second);
+            fbb.startTable();
+            fbb.addOffset(0, key);
+            fbb.addOffset(1, value);
+            keyValues.push_back(fbb.endTable());
+        }
+        metadataVector = fbb.createOffsetVector(keyValues);
+    }
+
+    fbb.startTable();
+    fbb.addScalar<int16_t>(0, METADATA_V5);
+    fbb.addScalar<uint8_t>(1, headerType);
+    fbb.addOffset(2, header);
+    fbb.addScalar<int64_t>(3, bodyLength);
+    if (!metadata.empty())
+        fbb.addOffset(4, metadataVector);
+    return fbb.finish(fbb.endTable());
+}
+
+void appendScalar(std::string & out, int32_t val)
+{
+    out.append((const char *)&val, sizeof(val));
+}
+
+void padTo8(std::string & out)
+{
+    out.append((8 - out.size() % 8) % 8, '\0');
+}
+
+
+/*****************************************************************************/
+/* COLUMN BUILDER                                                            */
+/*****************************************************************************/
+
+/** The buffers of a column of the current record batch. */
+
+struct ColumnBuilder {
+    std::string validity;
+    std::string values;      ///< Values, or offsets of strings and binaries
+    std::string data;        ///< Bytes of the strings and binaries
+    int64_t length = 0;
+    int64_t nullCount = 0;
+
+    void clear(ArrowType type)
+    {
+        validity.clear();
+        values.clear();
+        data.clear();
+        length = nullCount = 0;
+        if (type == ArrowType::UTF8 || type == ArrowType::BINARY)
+            appendScalar(values, 0);
+    }
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* ARROW WRITER                                                              */
+/*****************************************************************************/
+
+struct ArrowWriter::Itl {
+    Itl(std::vector<ArrowField> fields,
+        std::function<void (std::string)> write,
+        bool fileFormat,
+        size_t rowsPerBatch)
+        : fields(std::move(fields)), write(std::move(write)),
+          fileFormat(fileFormat), rowsPerBatch(std::max<size_t>(rowsPerBatch, 1)),
+          columns(this->fields.size())
+    {
+    }
+
+    std::vector<ArrowField> fields;
+    std::function<void (std::string)> write;
+    bool fileFormat;
+    size_t rowsPerBatch;
+
+    /// Until the schema is written, rows are kept as they are, so that
+    /// the types can be chosen from them
+    bool schemaWritten = false;
+    std::vector<std::vector<CellValue> > heldRows;
+
+    std::vector<ColumnBuilder> columns;
+    int64_t batchRows = 0;
+    size_t batchBytes = 0;
+    uint64_t rowCount = 0;
+    bool finished = false;
+
+    /// Bytes written so far, and where the record batches are
+    uint64_t offset = 0;
+    std::vector<Block> recordBatches;
+
+    void output(std::string data)
+    {
+        offset += data.size();
+        write(std::move(data));
+    }
+
+    /// Write an encapsulated message, returning its block
+    Block writeMessage(const std::string & metadata, std::string body)
+    {
+        ExcAssertEqual(metadata.size() % 8, 0);
+        ExcAssertEqual(body.size() % 8, 0);
+        Block block;
+        block.offset = offset;
+        block.metaDataLength = metadata.size() + 8;
+        block.padding = 0;
+        block.bodyLength = body.size();
+
+        std::string header;
+        appendScalar(header, -1);        // continuation marker
+        appendScalar(header, metadata.size());
+        output(header + metadata);
+        if (!body.empty())
+            output(std::move(body));
+        return block;
+    }
+
+    void writeSchema()
+    {
+        for (auto & f: fields) {
+            if (f.type == ArrowType::NONE)
+                f.type = ArrowType::UTF8;
+        }
+
+        if (fileFormat)
+            output(std::string("ARROW1\0\0", 8));
+
+        FlatBufferBuilder fbb;
+        Offset schema = buildSchema(fbb, fields);
+        writeMessage(finishMessage(fbb, HEADER_SCHEMA, schema, 0), "");
+
+        for (size_t i = 0;  i < fields.size();  ++i)
+            columns[i].clear(fields[i].type);
+        schemaWritten = true;
+    }
+
+    void checkFits(size_t i, const CellValue & value) const
+    {
+        if (value.empty())
+            return;
+        bool fits;
+        switch (fields[i].type) {
+        case ArrowType::INT64:
+            fits = value.isInteger() && value.isInt64();  break;
+        case ArrowType::FLOAT64:
+            fits = value.isNumeric();  break;
+        case ArrowType::TIMESTAMP:
+            fits = value.isTimestamp();  break;
+        case ArrowType::UTF8:
+            fits = !value.isBlob();  break;
+        default:
+            fits = true;
+        }
+        if (!fits)
+            throw AnnotatedException
+                (400, "Value '" + value.toUtf8String() + "' of column '"
+                 + fields[i].name + "' can't be written to its Arrow column "
+                 "of type " + arrowTypeName(fields[i].type) + ", which was "
+                 "chosen from the values of the first rows",
+                 "column", fields[i].name);
+    }
+
+    void append(size_t i, const CellValue * value)
+    {
+        ColumnBuilder & col = columns[i];
+        ArrowType type = fields[i].type;
+        bool valid = value && !value->empty();
+
+        if (col.length % 8 == 0)
+            col.validity.push_back(0);
+        if (valid)
+            col.validity.back() |= 1 << (col.length % 8);
+        else ++col.nullCount;
+        ++col.length;
+
+        if (type == ArrowType::UTF8 || type == ArrowType::BINARY) {
+            size_t before = col.data.size();
+            if (valid) {
+                if (value->isBlob())
+                    col.data.append((const char *)value->blobData(),
+                                    value->blobLength());
+                else if (value->isPath())
+                    col.data += value->coerceToPath().toUtf8String().rawString();
+                else col.data += value->toUtf8String().rawString();
+            }
+            if (col.data.size() > std::numeric_limits<int32_t>::max())
+                throw AnnotatedException
+                    (400, "Column '" + fields[i].name + "' has more than "
+                     "2GB of data in a single Arrow record batch; use "
+                     "fewer rows per batch");
+            appendScalar(col.values, col.data.size());
+            batchBytes += col.data.size() - before;
+            return;
+        }
+
+        int64_t bits = 0;
+        if (valid) {
+            if (type == ArrowType::INT64) {
+                bits = value->toInt();
+            }
+            else if (type == ArrowType::FLOAT64) {
+                double d = value->toDouble();
+                memcpy(&bits, &d, sizeof(d));
+            }
+            else {
+                bits = std::llround(value->toTimestamp().secondsSinceEpoch()
+                                    * 1000000.0);
+            }
+        }
+        col.values.append((const char *)&bits, sizeof(bits));
+        batchBytes += sizeof(bits);
+    }
+
+    void encodeRow(const CellValue * const * values)
+    {
+        for (size_t i = 0;  i < fields.size();  ++i) {
+            if (values[i])
+                checkFits(i, *values[i]);
+        }
+        for (size_t i = 0;  i < fields.size();  ++i)
+            append(i, values[i]);
+        ++batchRows;
+    }
+
+    void writeBatch(const std::vector<std::pair<std::string, std::string> >
+                        & metadata = {})
+    {
+        std::string body;
+        std::vector<FieldNode> nodes;
+        std::vector<BufferRef> buffers;
+
+        auto addBuffer = [&] (const std::string & data)
+            {
+                buffers.push_back({ (int64_t)body.size(), (int64_t)data.size() });
+                body += data;
+                padTo8(body);
+            };
+
+        for (size_t i = 0;  i < fields.size();  ++i) {
+            ColumnBuilder & col = columns[i];
+            nodes.push_back({ col.length, col.nullCount });
+            // Without nulls, the validity bitmap can be left out
+            addBuffer(col.nullCount ? col.validity : std::string());
+            addBuffer(col.values);
+            if (fields[i].type == ArrowType::UTF8
+                || fields[i].type == ArrowType::BINARY)
+                addBuffer(col.data);
+            col.clear(fields[i].type);
+        }
+
+        FlatBufferBuilder fbb;
+        Offset nodesVector = fbb.createStructVector(nodes);
+        Offset buffersVector = fbb.createStructVector(buffers);
+        fbb.startTable();
+        fbb.addScalar<int64_t>(0, batchRows);
+        fbb.addOffset(1, nodesVector);
+        fbb.addOffset(2, buffersVector);
+        Offset batch = fbb.endTable();
+
+        size_t bodyLength = body.size();
+        recordBatches.push_back
+            (writeMessage(finishMessage(fbb, HEADER_RECORD_BATCH, batch,
+                                        bodyLength, metadata),
+                          std::move(body)));
+        batchRows = 0;
+        batchBytes = 0;
+    }
+
+    void flush()
+    {
+        ExcAssert(!finished);
+        if (!schemaWritten) {
+            for (auto & row: heldRows) {
+                for (size_t i = 0;  i < fields.size();  ++i)
+                    fields[i].type = widenArrowType(fields[i].type, row[i]);
+            }
+            writeSchema();
+            std::vector<const CellValue *> values(fields.size());
+            for (auto & row: heldRows) {
+                for (size_t i = 0;  i < fields.size();  ++i)
+                    values[i] = &row[i];
+                encodeRow(values.data());
+            }
+            heldRows.clear();
+        }
+        if (batchRows > 0)
+            writeBatch();
+    }
+
+    void writeEnd()
+    {
+        std::string eos;
+        appendScalar(eos, -1);
+        appendScalar(eos, 0);
+        output(eos);
+
+        if (fileFormat) {
+            FlatBufferBuilder fbb;
+            Offset schema = buildSchema(fbb, fields);
+            Offset dictionaries = fbb.createStructVector(std::vector<Block>());
+            Offset batches = fbb.createStructVector(recordBatches);
+            fbb.startTable();
+            fbb.addScalar<int16_t>(0, METADATA_V5);
+            fbb.addOffset(1, schema);
+            fbb.addOffset(2, dictionaries);
+            fbb.addOffset(3, batches);
+            std::string footer = fbb.finish(fbb.endTable());
+            appendScalar(footer, footer.size());
+            footer += "ARROW1";
+            output(std::move(footer));
+        }
+        finished = true;
+    }
+};
+
+ArrowWriter::
+ArrowWriter(std::vector<ArrowField> fields,
+            std::function<void (std::string)> write,
+            bool fileFormat,
+            size_t rowsPerBatch)
+    : itl(new Itl(std::move(fields), std::move(write), fileFormat,
+                  rowsPerBatch))
+{
+}
+
+ArrowWriter::
+~ArrowWriter()
+{
+}
+
+void
+ArrowWriter::
+addRow(const CellValue * const * values)
+{
+    ExcAssert(!itl->finished);
+    if (!itl->schemaWritten) {
+        std::vector<CellValue> row(itl->fields.size());
+        for (size_t i = 0;  i < row.size();  ++i) {
+            if (values[i])
+                row[i] = *values[i];
+        }
+        itl->heldRows.emplace_back(std::move(row));
+        ++itl->rowCount;
+        if (itl->heldRows.size() >= itl->rowsPerBatch)
+            itl->flush();
+        return;
+    }
+
+    itl->encodeRow(values);
+    ++itl->rowCount;
+    if (itl->batchRows >= itl->rowsPerBatch
+        || itl->batchBytes >= 256 * 1024 * 1024)
+        itl->writeBatch();
+}
+
+void
+ArrowWriter::
+flush()
+{
+    itl->flush();
+}
+
+void
+ArrowWriter::
+finish()
+{
+    itl->flush();
+    itl->writeEnd();
+}
+
+void
+ArrowWriter::
+finishWithError(const std::string & error, int httpCode)
+{
+    ExcAssert(!itl->fileFormat);
+    itl->flush();
+    itl->writeBatch({ { "error", error },
+                      { "httpCode", std::to_string(httpCode) } });
+    itl->writeEnd();
+}
+
+const std::vector<ArrowField> &
+ArrowWriter::
+fields() const
+{
+    return itl->fields;
+}
+
+uint64_t
+ArrowWriter::
+rowCount() const
+{
+    return itl->rowCount;
+}
+
+} // namespace MLDB
@@ -0,0 +1,109 @@
+/** arrow_writer.h                                                 -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Writer for the Apache Arrow IPC formats.
+*/
+
+#pragma once
+
+#include "mldb/sql/cell_value.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/** Type of the values of an Arrow column. */
+
+enum class ArrowType {
+    NONE,        ///< Not known yet; chosen from the values
+    INT64,       ///< Signed 64 bit integer
+    FLOAT64,     ///< Double precision floating point
+    TIMESTAMP,   ///< Microseconds since the epoch, UTC
+    UTF8,        ///< UTF-8 string
+    BINARY       ///< Bytes
+};
+
+/** Return the name of the type, as used in error messages. */
+const char * arrowTypeName(ArrowType type);
+
+/** Return the narrowest type that can hold both values of the given type
+    and the given value.  Integers and floating point numbers make a
+    floating point column, blobs make anything binary, and other mixtures
+    are converted to strings.
+*/
+ArrowType widenArrowType(ArrowType type, const CellValue & value);
+
+
+/*****************************************************************************/
+/* ARROW FIELD                                                               */
+/*****************************************************************************/
+
+struct ArrowField {
+    Utf8String name;
+    ArrowType type = ArrowType::NONE;
+};
+
+
+/*****************************************************************************/
+/* ARROW WRITER                                                              */
+/*****************************************************************************/
+
+/** Writes rows of CellValues as an Arrow IPC stream or file (the latter
+    being the format of Feather version 2), with each column stored
+    contiguously so that readers can use it in place.
+
+    Rows are gathered into record batches.  The types of fields that are
+    created as NONE are chosen from the values of the first batch, after
+    which a value that doesn't fit its column's type is an error.  Fields
+    that are entirely null in the first batch are strings.
+
+    The output is passed to the write function as it is produced.  Errors
+    are reported by throwing an exception.
+*/
+
+struct ArrowWriter {
+    /** Create a writer for the given fields.  If fileFormat is true, the
+        IPC file format is written (which can be read with random access,
+        but must be written to the end), otherwise the IPC stream format.
+    */
+    ArrowWriter(std::vector<ArrowField> fields,
+                std::function<void (std::string)> write,
+                bool fileFormat = false,
+                size_t rowsPerBatch = 65536);
+
+    ~ArrowWriter();
+
+    /** Add a row, which has one value per field (a null pointer or an
+        empty value being null).
+    */
+    void addRow(const CellValue * const * values);
+
+    /** Write out the rows that have been added into a record batch. */
+    void flush();
+
+    /** Write the rest of the output.  Nothing may be added afterwards. */
+    void finish();
+
+    /** Write the rest of a stream whose production was interrupted by
+        the given error.  Since a stream can't otherwise carry an error,
+        it's the custom metadata (with keys "error" and "httpCode") of an
+        empty record batch that ends the stream.
+    */
+    void finishWithError(const std::string & error, int httpCode);
+
+    /** The fields, with their types once they have been chosen. */
+    const std::vector<ArrowField> & fields() const;
+
+    /** Number of rows that have been added. */
+    uint64_t rowCount() const;
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+} // namespace MLDB
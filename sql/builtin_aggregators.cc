@@ -10,6 +10,7 @@
 #include "mldb/types/annotated_exception.h"
 #include "mldb/utils/distribution.h"
 #include "mldb/utils/csv.h"
+#include "mldb/utils/sketches.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/base/optimized_path.h"
 #include <array>
@@ -111,6 +112,19 @@ struct AggregatorT {
         State * srcState = static_cast<State *>(src);
         state->merge(srcState);
     }
+
+    static std::shared_ptr<void> scalarClone(void * data)
+    {
+        return std::make_shared<State>(*static_cast<State *>(data));
+    }
+
+    /// States that own their sketch through a unique_ptr can't be copied
+    static std::function<std::shared_ptr<void> (void *)> getScalarClone()
+    {
+        if constexpr (std::is_copy_constructible<State>::value)
+            return scalarClone;
+        else return nullptr;
+    }
     
     /** Entry point for when we are called with the first argument as a scalar.
         This does a normal SQL aggregation.
@@ -118,7 +132,8 @@ struct AggregatorT {
     static BoundAggregator enterScalar(const std::vector<BoundSqlExpression> & args,
                                        const string & name)
     {
-        return { scalarInit, scalarProcess, scalarExtract, scalarMerge, State::info(args) };
+        return { scalarInit, scalarProcess, scalarExtract, scalarMerge,
+                 State::info(args), getScalarClone() };
     }
 
     //////// Row ///////////
@@ -856,6 +871,374 @@ struct DistinctAccum {
 
 static RegisterAggregatorT<DistinctAccum> registerDistinct("count_distinct");
 
+/** Return the sketch that was serialized into the given value by one of
+    the *_sketch or *_merge aggregators.
+*/
+template<typename Sketch>
+static Sketch getSketch(const ExpressionValue & val, const char * kind,
+                        const char * function)
+{
+    CellValue atom = val.getAtom();
+    if (!atom.isBlob()
+        || !Sketch::isSerialized((const char *)atom.blobData(),
+                                 atom.blobLength()))
+        throw AnnotatedException(400, "Function " + string(function)
+                                 + " expects a " + kind + " sketch as made "
+                                 "by the " + kind + "_sketch aggregator",
+                                 "value", val);
+    return Sketch::reconstitute((const char *)atom.blobData(),
+                                atom.blobLength());
+}
+
+/// Hash of a value for the sketches, which must be the same from run to
+/// run so that saved sketches can be merged with new ones
+static uint64_t sketchHash(const ExpressionValue & val)
+{
+    return val.getAtom().hash().hash();
+}
+
+/** Accumulates the distinct values in a HyperLogLog sketch, for
+    approx_count_distinct (which outputs the estimated count) and
+    hll_sketch (which outputs the sketch).  Unlike count_distinct, it
+    uses at most 16kb for each group whatever the number of values.
+*/
+template<bool OutputSketch>
+struct HyperLogLogAccum {
+    static constexpr int nargs = 1;
+    static constexpr int maxArgs = nargs;
+    HyperLogLogAccum()
+        : ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        if (OutputSketch)
+            return std::make_shared<BlobValueInfo>();
+        return std::make_shared<IntegerValueInfo>();
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 1);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        sketch.insertHash(sketchHash(val));
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    ExpressionValue extract()
+    {
+        if (OutputSketch)
+            return ExpressionValue(CellValue::blob(sketch.serialize()), ts);
+        return ExpressionValue((uint64_t)std::llround(sketch.estimate()), ts);
+    }
+
+    void merge(HyperLogLogAccum * src)
+    {
+        sketch.merge(src->sketch);
+        ts.setMax(src->ts);
+    }
+
+    HyperLogLog sketch;
+    Date ts;
+};
+
+static RegisterAggregatorT<HyperLogLogAccum<false> >
+registerApproxCountDistinct("approx_count_distinct");
+static RegisterAggregatorT<HyperLogLogAccum<true> >
+registerHllSketch("hll_sketch");
+
+/** Accumulates the numbers in a t-digest, for approx_quantile(x, q),
+    approx_median(x) and tdigest_sketch(x).  The quantile must be the
+    same for all of the rows of a group.
+*/
+template<bool OutputSketch, bool Median>
+struct TDigestAccum {
+    static constexpr int nargs = OutputSketch || Median ? 1 : 2;
+    static constexpr int maxArgs = nargs;
+    TDigestAccum()
+        : q(Median ? 0.5 : -1), ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        if (OutputSketch)
+            return std::make_shared<BlobValueInfo>();
+        return std::make_shared<Float64ValueInfo>();
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, TDigestAccum::nargs);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        if (q == -1) {
+            q = args[1].toDouble();
+            if (!(q >= 0 && q <= 1))
+                throw AnnotatedException(400, "approx_quantile requires a "
+                                         "quantile between 0 and 1",
+                                         "quantile", args[1]);
+        }
+
+        sketch.insert(val.toDouble());
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    ExpressionValue extract()
+    {
+        if (OutputSketch)
+            return ExpressionValue(CellValue::blob(sketch.serialize()), ts);
+        if (sketch.weight() == 0)
+            return ExpressionValue::null(ts);
+        return ExpressionValue(sketch.quantile(q), ts);
+    }
+
+    void merge(TDigestAccum * src)
+    {
+        if (q == -1)
+            q = src->q;
+        sketch.merge(src->sketch);
+        ts.setMax(src->ts);
+    }
+
+    TDigest sketch;
+    double q;
+    Date ts;
+};
+
+static RegisterAggregatorT<TDigestAccum<false, false> >
+registerApproxQuantile("approx_quantile");
+static RegisterAggregatorT<TDigestAccum<false, true> >
+registerApproxMedian("approx_median");
+static RegisterAggregatorT<TDigestAccum<true, false> >
+registerTDigestSketch("tdigest_sketch");
+
+/// Turn the most frequent values of a sketch into a row of their counts
+static ExpressionValue topKRow(const HeavyHitters & sketch, Date ts)
+{
+    StructValue result;
+    for (auto & entry: sketch.top()) {
+        result.emplace_back(PathElement(Utf8String(entry.value)),
+                            ExpressionValue(entry.count, ts));
+    }
+    return ExpressionValue(std::move(result));
+}
+
+/** Accumulates the most frequent values, for approx_top_k(x, k) (which
+    outputs a row of the k most frequent values with their estimated
+    counts) and top_k_sketch(x, k).
+*/
+template<bool OutputSketch>
+struct HeavyHittersAccum {
+    static constexpr int nargs = 2;
+    static constexpr int maxArgs = nargs;
+    HeavyHittersAccum()
+        : ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        if (OutputSketch)
+            return std::make_shared<BlobValueInfo>();
+        return std::make_shared<RowValueInfo>(std::vector<KnownColumn>(),
+                                              SCHEMA_OPEN);
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 2);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        if (!sketch) {
+            int64_t k = args[1].getAtom().toInt();
+            if (k < 1 || k > 100000)
+                throw AnnotatedException(400, "approx_top_k requires a "
+                                         "number of values between 1 and "
+                                         "100000", "k", args[1]);
+            sketch.reset(new HeavyHitters(k));
+        }
+
+        CellValue atom = val.getAtom();
+        sketch->insert(atom.toUtf8String().rawString(), atom.hash().hash());
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    ExpressionValue extract()
+    {
+        if (!sketch)
+            sketch.reset(new HeavyHitters());
+        if (OutputSketch)
+            return ExpressionValue(CellValue::blob(sketch->serialize()), ts);
+        return topKRow(*sketch, ts);
+    }
+
+    void merge(HeavyHittersAccum * src)
+    {
+        if (!src->sketch)
+            return;
+        if (!sketch)
+            sketch = std::move(src->sketch);
+        else sketch->merge(*src->sketch);
+        ts.setMax(src->ts);
+    }
+
+    std::unique_ptr<HeavyHitters> sketch;
+    Date ts;
+};
+
+static RegisterAggregatorT<HeavyHittersAccum<false> >
+registerApproxTopK("approx_top_k");
+static RegisterAggregatorT<HeavyHittersAccum<true> >
+registerTopKSketch("top_k_sketch");
+
+/** Merges sketches made by the *_sketch aggregators (or other *_merge
+    aggregators) into one, for example to combine daily sketches into a
+    monthly one.
+*/
+template<typename Sketch, const char * Kind, const char * Name>
+struct SketchMergeAccum {
+    static constexpr int nargs = 1;
+    static constexpr int maxArgs = nargs;
+    SketchMergeAccum()
+        : ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        return std::make_shared<BlobValueInfo>();
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 1);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        Sketch other = getSketch<Sketch>(val, Kind, Name);
+        if (!sketch)
+            sketch.reset(new Sketch(std::move(other)));
+        else sketch->merge(other);
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    ExpressionValue extract()
+    {
+        if (!sketch)
+            return ExpressionValue::null(ts);
+        return ExpressionValue(CellValue::blob(sketch->serialize()), ts);
+    }
+
+    void merge(SketchMergeAccum * src)
+    {
+        if (!src->sketch)
+            return;
+        if (!sketch)
+            sketch = std::move(src->sketch);
+        else sketch->merge(*src->sketch);
+        ts.setMax(src->ts);
+    }
+
+    std::unique_ptr<Sketch> sketch;
+    Date ts;
+};
+
+extern const char hllKind[] = "hll";
+extern const char hllMergeName[] = "hll_merge";
+extern const char tdigestKind[] = "tdigest";
+extern const char tdigestMergeName[] = "tdigest_merge";
+extern const char topKKind[] = "top_k";
+extern const char topKMergeName[] = "top_k_merge";
+
+static RegisterAggregatorT<SketchMergeAccum<HyperLogLog, hllKind, hllMergeName> >
+registerHllMerge("hll_merge");
+static RegisterAggregatorT<SketchMergeAccum<TDigest, tdigestKind, tdigestMergeName> >
+registerTDigestMerge("tdigest_merge");
+static RegisterAggregatorT<SketchMergeAccum<HeavyHitters, topKKind, topKMergeName> >
+registerTopKMerge("top_k_merge");
+
+BoundFunction hll_estimate(const std::vector<BoundSqlExpression> & args)
+{
+    checkArgsSize(args.size(), 1);
+    return {[] (const std::vector<ExpressionValue> & args,
+                const SqlRowScope & scope) -> ExpressionValue
+            {
+                checkArgsSize(args.size(), 1);
+                if (args[0].empty())
+                    return ExpressionValue::null(args[0].getEffectiveTimestamp());
+                auto sketch = getSketch<HyperLogLog>(args[0], "hll",
+                                                     "hll_estimate");
+                return ExpressionValue((uint64_t)std::llround(sketch.estimate()),
+                                       args[0].getEffectiveTimestamp());
+            },
+            std::make_shared<IntegerValueInfo>()
+    };
+}
+
+static RegisterBuiltin registerHllEstimate(hll_estimate, "hll_estimate");
+
+BoundFunction tdigest_quantile(const std::vector<BoundSqlExpression> & args)
+{
+    checkArgsSize(args.size(), 2);
+    return {[] (const std::vector<ExpressionValue> & args,
+                const SqlRowScope & scope) -> ExpressionValue
+            {
+                checkArgsSize(args.size(), 2);
+                Date ts = calcTs(args[0], args[1]);
+                if (args[0].empty() || args[1].empty())
+                    return ExpressionValue::null(ts);
+                double q = args[1].toDouble();
+                if (!(q >= 0 && q <= 1))
+                    throw AnnotatedException(400, "tdigest_quantile requires "
+                                             "a quantile between 0 and 1",
+                                             "quantile", args[1]);
+                auto sketch = getSketch<TDigest>(args[0], "tdigest",
+                                                 "tdigest_quantile");
+                if (sketch.weight() == 0)
+                    return ExpressionValue::null(ts);
+                return ExpressionValue(sketch.quantile(q), ts);
+            },
+            std::make_shared<Float64ValueInfo>()
+    };
+}
+
+static RegisterBuiltin registerTDigestQuantile(tdigest_quantile,
+                                               "tdigest_quantile");
+
+BoundFunction top_k_values(const std::vector<BoundSqlExpression> & args)
+{
+    checkArgsSize(args.size(), 1);
+    return {[] (const std::vector<ExpressionValue> & args,
+                const SqlRowScope & scope) -> ExpressionValue
+            {
+                checkArgsSize(args.size(), 1);
+                if (args[0].empty())
+                    return ExpressionValue::null(args[0].getEffectiveTimestamp());
+                auto sketch = getSketch<HeavyHitters>(args[0], "top_k",
+                                                      "top_k_values");
+                return topKRow(sketch, args[0].getEffectiveTimestamp());
+            },
+            std::make_shared<RowValueInfo>(std::vector<KnownColumn>(),
+                                           SCHEMA_OPEN)
+    };
+}
+
+static RegisterBuiltin registerTopKValues(top_k_values, "top_k_values");
+
 struct LikelihoodRatioAccum {
     LikelihoodRatioAccum()
         : ts(Date::negativeInfinity())
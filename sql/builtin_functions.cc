@@ -7,11 +7,14 @@
 
 #include "mldb/sql/builtin_functions.h"
 #include "sql_expression.h"
+#include "sql_batch.h"
 #include "tokenize.h"
 #include "regex_helper.h"
+#include "json_extract.h"
 #include "mldb/types/annotated_exception.h"
 #include "mldb/utils/distribution.h"
 #include "mldb/utils/distribution_simd.h"
+#include "mldb/arch/simd_vector.h"
 #include "mldb/utils/csv.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/utils/confidence_intervals.h"
@@ -32,6 +35,7 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <set>
 #include <magic.h>
 
 using namespace std;
@@ -54,6 +58,30 @@ CellValue getArg(const std::vector<ExpressionValue> & args,
 
 namespace Builtins {
 
+namespace {
+
+std::mutex nonDeterministicMutex;
+
+std::set<Utf8String> & nonDeterministicBuiltins()
+{
+    static std::set<Utf8String> result;
+    return result;
+}
+
+} // file scope
+
+void noteNonDeterministicBuiltin(const Utf8String & name)
+{
+    std::unique_lock<std::mutex> guard(nonDeterministicMutex);
+    nonDeterministicBuiltins().insert(name);
+}
+
+bool isNonDeterministicBuiltin(const Utf8String & name)
+{
+    std::unique_lock<std::mutex> guard(nonDeterministicMutex);
+    return nonDeterministicBuiltins().count(name);
+}
+
 
 /*****************************************************************************/
 /* UNARY SCALARS                                                             */
@@ -61,6 +89,10 @@ namespace Builtins {
 
 typedef CellValue (*UnaryScalarFunction) (const CellValue & arg);
 
+/// Version of a unary scalar function for numbers, which returns the
+/// same as the UnaryScalarFunction for a non-null number
+typedef double (*UnaryDoubleFunction) (double arg);
+
 /// Register a builtin function that operates on unary scalars with a
 /// signature (Atom) -> Atom, to work on scalars, rows or
 /// embeddings.
@@ -74,6 +106,20 @@ struct RegisterBuiltinUnaryScalar {
         doRegister(function, std::move(info), std::forward<Names>(names)...);
     }
 
+    /// Register a function with a version for numbers, which is used to
+    /// apply it to batches of numbers
+    template<typename... Names>
+    RegisterBuiltinUnaryScalar(const UnaryScalarFunction & function,
+                               UnaryDoubleFunction doubleFunction,
+                               std::shared_ptr<ExpressionValueInfo> info,
+                               Names&&... names)
+        : doubleFunction(doubleFunction)
+    {
+        doRegister(function, std::move(info), std::forward<Names>(names)...);
+    }
+
+    UnaryDoubleFunction doubleFunction = nullptr;
+
     void doRegister(const UnaryScalarFunction & function)
     {
     }
@@ -169,11 +215,43 @@ struct RegisterBuiltinUnaryScalar {
     static BoundFunction
     bindScalar(const Utf8String & functionName,
                UnaryScalarFunction fn,
+               UnaryDoubleFunction doubleFn,
                std::shared_ptr<ExpressionValueInfo> info,
                const std::vector<BoundSqlExpression> & args,
                const SqlBindingScope & scope)
     {
-        return wrap(functionName, fn, std::move(info), applyScalar);
+        BoundFunction result
+            = wrap(functionName, fn, std::move(info), applyScalar);
+
+        result.batchExec = [=] (const std::vector<SqlBatchVector> & args,
+                                SqlBatchVector & out)
+            {
+                const SqlBatchVector & arg = args[0];
+                size_t n = arg.size();
+                try {
+                    if (doubleFn && arg.isNumeric()) {
+                        out.initDoubles(n);
+                        for (size_t i = 0;  i < n;  ++i) {
+                            if (arg.isNull(i))
+                                out.setNull(i);
+                            else out.doubles[i] = doubleFn(arg.getDouble(i));
+                        }
+                        return;
+                    }
+
+                    std::vector<CellValue> values(n);
+                    for (size_t i = 0;  i < n;  ++i)
+                        values[i] = fn(arg.getCell(i));
+                    out.initCells(std::move(values));
+                } MLDB_CATCH_ALL {
+                    rethrowException(-1, "Executing builtin function "
+                                         + functionName
+                                         + ": " + getExceptionString(),
+                                         "functionName", functionName);
+                }
+            };
+
+        return result;
     }
 
     static BoundFunction
@@ -223,6 +301,7 @@ struct RegisterBuiltinUnaryScalar {
                     std::string name,
                     Names&&... names)
     {
+        UnaryDoubleFunction doubleFn = doubleFunction;
         auto fn = [=] (const Utf8String & functionName,
                        const std::vector<BoundSqlExpression> & args,
                        SqlBindingScope & scope)
@@ -231,7 +310,7 @@ struct RegisterBuiltinUnaryScalar {
                 try {
                     checkArgsSize(args.size(), 1);
                     if (args[0].info->isScalar())
-                        return bindScalar(functionName, function,
+                        return bindScalar(functionName, function, doubleFn,
                                           std::move(info), args,
                                           scope);
                     else if (args[0].info->isEmbedding()) {
@@ -283,7 +362,7 @@ struct RegisterBuiltinUnaryNumericScalar: public RegisterBuiltinUnaryScalar {
 
     template<typename... Names>
     RegisterBuiltinUnaryNumericScalar(Names&&... names)
-        : RegisterBuiltinUnaryScalar(&call,
+        : RegisterBuiltinUnaryScalar(&call, &Op::call,
                                      std::make_shared<Float64ValueInfo>(),
                                      std::forward<Names>(names)...)
     {
@@ -523,7 +602,28 @@ struct RegisterBuiltinBinaryScalar {
                      const std::vector<BoundSqlExpression> & args,
                      const SqlBindingScope & scope)
     {
-        return wrap(functionName, fn, std::move(info), applyScalarScalar);
+        BoundFunction result
+            = wrap(functionName, fn, std::move(info), applyScalarScalar);
+
+        result.batchExec = [=] (const std::vector<SqlBatchVector> & args,
+                                SqlBatchVector & out)
+            {
+                size_t n = args[0].size();
+                try {
+                    std::vector<CellValue> values(n);
+                    for (size_t i = 0;  i < n;  ++i)
+                        values[i] = fn(args[0].getCell(i),
+                                       args[1].getCell(i));
+                    out.initCells(std::move(values));
+                } MLDB_CATCH_ALL {
+                    rethrowException(-1, "Executing builtin function "
+                                         + functionName
+                                         + ": " + getExceptionString(),
+                                         "functionName", functionName);
+                }
+            };
+
+        return result;
     }
 
     static BoundFunction
@@ -1772,59 +1872,91 @@ ParseJsonOptionsDescription()
             "keys and boolean true values");
 }
 
-BoundFunction parse_json(const std::vector<BoundSqlExpression> & args)
+static ExpressionValue
+parseJsonValue(const ExpressionValue & val, const ParseJsonOptions & options)
 {
-    if (args.size() > 2 || args.size() < 1)
-        throw AnnotatedException(400, " takes 1 or 2 argument, got " + to_string(args.size()));
-
+    if(val.empty())
+        return ExpressionValue::null(val.getEffectiveTimestamp());
 
-    return {[=] (const std::vector<ExpressionValue> & args,
-                 const SqlRowScope & scope) -> ExpressionValue
-            {
-                ExcAssert(args.size() > 0 && args.size() < 3);
-                auto & val = args[0];
+    try {
+        MLDB_TRACE_EXCEPTIONS(!options.ignoreErrors);
+
+        Utf8String str = val.toUtf8String();
+        StreamingJsonParsingContext parser(str.rawString(),
+                                           str.rawData(),
+                                           str.rawLength());
+
+        if (!parser.isObject() && !parser.isArray())
+            throw AnnotatedException(400, "JSON passed to parse_json must be "
+                    "an object or an array; got '" + str + "'",
+                                      "json", str);
+
+        return ExpressionValue::
+            parseJson(parser, val.getEffectiveTimestamp(),
+                      options.arrays);
+    }
+    catch(std::exception & e) {
+        if(options.ignoreErrors) {
+            RowValue rv;
+            rv.emplace_back(make_tuple(Path("__parse_json_error__"),
+                                       CellValue(true),
+                                       //CellValue(e.what()),
+                                       val.getEffectiveTimestamp()));
+            return ExpressionValue(std::move(rv));
+        }
 
-                if(val.empty())
-                    return ExpressionValue::null(val.getEffectiveTimestamp());
+        throw;
+    }
+}
 
-                ParseJsonOptions options;
+BoundFunction parse_json(const std::vector<BoundSqlExpression> & args)
+{
+    if (args.size() > 2 || args.size() < 1)
+        throw AnnotatedException(400, " takes 1 or 2 argument, got " + to_string(args.size()));
 
-                if(args.size() == 2) {
-                    options = args[1].extractT<ParseJsonOptions>();
-                }
 
-                try {
-                    MLDB_TRACE_EXCEPTIONS(!options.ignoreErrors);
+    BoundFunction result
+        = {[=] (const std::vector<ExpressionValue> & args,
+                const SqlRowScope & scope) -> ExpressionValue
+           {
+               ExcAssert(args.size() > 0 && args.size() < 3);
 
-                    Utf8String str = val.toUtf8String();
-                    StreamingJsonParsingContext parser(str.rawString(),
-                                                       str.rawData(),
-                                                       str.rawLength());
+               ParseJsonOptions options;
 
-                    if (!parser.isObject() && !parser.isArray())
-                        throw AnnotatedException(400, "JSON passed to parse_json must be "
-                                "an object or an array; got '" + str + "'",
-                                                  "json", str);
+               if(args.size() == 2) {
+                   options = args[1].extractT<ParseJsonOptions>();
+               }
 
-                    return ExpressionValue::
-                        parseJson(parser, val.getEffectiveTimestamp(),
-                                  options.arrays);
-                }
-                catch(std::exception & e) {
-                    if(options.ignoreErrors) {
-                        RowValue rv;
-                        rv.emplace_back(make_tuple(Path("__parse_json_error__"),
-                                                   CellValue(true),
-                                                   //CellValue(e.what()),
-                                                   val.getEffectiveTimestamp()));
-                        return ExpressionValue(std::move(rv));
-                    }
+               return parseJsonValue(args[0], options);
+           },
+           std::make_shared<UnknownRowValueInfo>()
+        };
 
-                    throw;
-                }
-            },
-            std::make_shared<UnknownRowValueInfo>()
+    // With the default options, reading one field of the result (for
+    // example parse_json(payload)[user.id]) only builds that field.
+    // Documents that the scanner can't handle are parsed in full.
+    if (args.size() == 1) {
+        result.extractColumn
+            = [] (const std::vector<ExpressionValue> & args,
+                  const ColumnPath & column,
+                  const VariableFilter & filter) -> ExpressionValue
+            {
+                auto & val = args[0];
+                ExpressionValue output;
+                if (val.isString()
+                    && tryExtractJsonColumn(val.getAtom().stringChars(),
+                                            val.getAtom().toStringLength(),
+                                            column,
+                                            val.getEffectiveTimestamp(),
+                                            filter, output))
+                    return output;
+
+                return parseJsonValue(val, ParseJsonOptions())
+                    .getNestedColumn(column, filter);
             };
+    }
+
+    return result;
 }
 
 static RegisterBuiltin registerJsonDecode(parse_json, "parse_json");
@@ -1878,13 +2010,45 @@ BoundFunction tokenize(const std::vector<BoundSqlExpression> & args)
                     options = args[1].extractT<TokenizeOptions>();
                 }
 
+                RowValue row;
+
+                auto getValue = [&] (int count) -> CellValue
+                    {
+                        if (!options.value.empty())
+                            return options.value;
+                        return count;
+                    };
+
+                if (options.hashBuckets > 0) {
+                    auto onBucket = [&] (uint64_t bucket, int count)
+                        {
+                            row.emplace_back(ColumnPath(PathElement(bucket)),
+                                             getValue(count), ts);
+                        };
+
+                    tokenizeHashed(text.rawData(), text.rawLength(), options,
+                                   onBucket);
+                    return ExpressionValue(std::move(row));
+                }
+
+                auto onToken = [&] (std::string_view token, int count)
+                    {
+                        row.emplace_back(ColumnPath(PathElement(token.data(),
+                                                                token.size())),
+                                         getValue(count), ts);
+                    };
+
+                if (tokenizeBytes(text.rawData(), text.rawLength(), options,
+                                  onToken)) {
+                    return ExpressionValue(std::move(row));
+                }
+
                 ParseContext pcontext(text.rawData(), text.rawData(), text.rawLength());
 
                 std::unordered_map<Utf8String, int> bagOfWords;
 
                 tokenize(bagOfWords, pcontext, options);
 
-                RowValue row;
                 row.reserve(bagOfWords.size());
 
                 auto it = bagOfWords.begin();
@@ -1988,6 +2152,149 @@ BoundFunction token_split(const std::vector<BoundSqlExpression> & args)
 
 static RegisterBuiltin registerToken_split(token_split, "split_part");
 
+namespace {
+
+/** Call fn(data, n) over the contiguous storage of val if it's an embedding
+    of floating point values, which the horizontal_* functions can reduce
+    directly instead of visiting each atom.  Returns false, without calling
+    fn, for any other kind of value.
+*/
+template<typename Fn>
+bool onFloatingEmbedding(const ExpressionValue & val, Fn && fn)
+{
+    if (!val.isEmbedding())
+        return false;
+
+    StorageType type = val.getEmbeddingType();
+    if (type != ST_FLOAT32 && type != ST_FLOAT64)
+        return false;
+
+    size_t n = 1;
+    for (auto & d: val.getEmbeddingShape())
+        n *= d;
+
+    std::shared_ptr<const void> data = val.getEmbeddingData();
+    if (type == ST_FLOAT32)
+        fn(static_cast<const float *>(data.get()), n);
+    else fn(static_cast<const double *>(data.get()), n);
+    return true;
+}
+
+/** Index of the first minimum (or maximum if Max) of x[0..n), which must
+    not be empty.  Returns -1 if there is a NaN, in which case the caller
+    needs to compare CellValues to keep their ordering of NaN.  The
+    comparisons are done in independent lanes so that they vectorize.
+*/
+template<bool Max, typename Float>
+ssize_t extremeIndex(const Float * x, size_t n)
+{
+    constexpr size_t LANES = 16;
+
+    Float lanes[LANES];
+    int nan[LANES];
+    for (size_t j = 0;  j < LANES;  ++j) {
+        lanes[j] = x[0];
+        nan[j] = 0;
+    }
+
+    size_t i = 0;
+    for (;  i + LANES <= n;  i += LANES) {
+        for (size_t j = 0;  j < LANES;  ++j) {
+            Float v = x[i + j];
+            nan[j] |= v != v;
+            lanes[j] = (Max ? v > lanes[j] : v < lanes[j]) ? v : lanes[j];
+        }
+    }
+
+    Float extreme = lanes[0];
+    bool anyNan = false;
+    for (size_t j = 0;  j < LANES;  ++j) {
+        anyNan = anyNan || nan[j];
+        extreme = (Max ? lanes[j] > extreme : lanes[j] < extreme)
+            ? lanes[j] : extreme;
+    }
+    for (;  i < n;  ++i) {
+        Float v = x[i];
+        anyNan = anyNan || v != v;
+        extreme = (Max ? v > extreme : v < extreme) ? v : extreme;
+    }
+
+    if (anyNan)
+        return -1;
+
+    // The generic path keeps the first of equal values (eg, 0 and -0)
+    for (i = 0;  x[i] != extreme;  ++i) ;
+    return i;
+}
+
+/** Sum of the numeric atoms of a row that isn't an embedding.  The values
+    are gathered into a contiguous buffer in one pass and summed with the
+    SIMD kernel, rather than accumulated one callback at a time.
+*/
+double sumRowAtoms(const ExpressionValue & row, size_t & count, Date & ts)
+{
+    std::vector<double> values;
+
+    auto onAtom = [&] (const Path & columnName,
+                       const Path & prefix,
+                       const CellValue & val,
+                       Date atomTs)
+        {
+            if (!val.empty()) {
+                values.push_back(val.toDouble());
+                ts.setMax(atomTs);
+            }
+            return true;
+        };
+
+    row.forEachAtom(onAtom);
+
+    count = values.size();
+    return SIMD::vec_sum(values.data(), values.size());
+}
+
+/** horizontal_min and horizontal_max, which only differ in the direction
+    of the comparison.
+*/
+template<bool Max>
+ExpressionValue horizontalExtreme(const ExpressionValue & row)
+{
+    ExpressionValue result;
+    auto onEmbedding = [&] (auto * data, size_t n)
+        {
+            ssize_t i = n == 0 ? -1 : extremeIndex<Max>(data, n);
+            if (i != -1)
+                result = ExpressionValue(CellValue(data[i]),
+                                         row.getEffectiveTimestamp());
+        };
+
+    if (onFloatingEmbedding(row, onEmbedding) && !result.empty())
+        return result;
+
+    CellValue extreme;
+    Date ts = Date::negativeInfinity();
+
+    auto onAtom = [&] (const Path & columnName,
+                       const Path & prefix,
+                       const CellValue & val,
+                       Date atomTs)
+        {
+            if (!val.empty()) {
+                if (extreme.empty() || (Max ? val > extreme : val < extreme)) {
+                    ts = atomTs;
+                    extreme = val;
+                }
+            }
+            return true;
+        };
+
+    row.forEachAtom(onAtom);
+
+    return ExpressionValue(extreme, ts);
+}
+
+} // file scope
+
 BoundFunction horizontal_count(const std::vector<BoundSqlExpression> & args)
 {
     checkArgsSize(args.size(), 1);
@@ -1998,6 +2305,17 @@ BoundFunction horizontal_count(const std::vector<BoundSqlExpression> & args)
                 size_t result = 0;
                 Date ts = Date::negativeInfinity();
 
+                // Every element of a floating point embedding is non-null
+                auto onEmbedding = [&] (auto * data, size_t n)
+                    {
+                        result = n;
+                        if (n > 0)
+                            ts = args[0].getEffectiveTimestamp();
+                    };
+
+                if (onFloatingEmbedding(args.at(0), onEmbedding))
+                    return ExpressionValue(result, ts);
+
                 auto onAtom = [&] (const Path & columnName,
                                    const Path & prefix,
                                    const CellValue & val,
@@ -2027,19 +2345,18 @@ BoundFunction horizontal_sum(const std::vector<BoundSqlExpression> & args)
             {
                 double result = 0;
                 Date ts = Date::negativeInfinity();
-                auto onAtom = [&] (const Path & columnName,
-                                   const Path & prefix,
-                                   const CellValue & val,
-                                   Date atomTs)
+
+                auto onEmbedding = [&] (auto * data, size_t n)
                     {
-                        if (!val.empty()) {
-                            result += val.toDouble();
-                            ts.setMax(atomTs);
-                        }
-                        return true;
+                        result = SIMD::vec_sum_dp(data, n);
+                        if (n > 0)
+                            ts = args[0].getEffectiveTimestamp();
                     };
 
-                args.at(0).forEachAtom(onAtom);
+                if (!onFloatingEmbedding(args.at(0), onEmbedding)) {
+                    size_t count;
+                    result = sumRowAtoms(args.at(0), count, ts);
+                }
 
                 return ExpressionValue(result, ts);
             },
@@ -2094,24 +2411,19 @@ BoundFunction horizontal_avg(const std::vector<BoundSqlExpression> & args)
     return {[=] (const std::vector<ExpressionValue> & args,
                  const SqlRowScope & scope) -> ExpressionValue
             {
-                int64_t num_cols = 0;
+                size_t num_cols = 0;
                 double accum = 0;
                 Date ts = Date::negativeInfinity();
 
-                auto onAtom = [&] (const Path & columnName,
-                                   const Path & prefix,
-                                   const CellValue & val,
-                                   Date atomTs)
+                auto onEmbedding = [&] (auto * data, size_t n)
                     {
-                        if (!val.empty()) {
-                            num_cols++;
-                            accum += val.toDouble();
-                            ts.setMax(atomTs);
-                        }
-                        return true;
+                        num_cols = n;
+                        accum = SIMD::vec_sum_dp(data, n);
+                        ts = args[0].getEffectiveTimestamp();
                     };
 
-                args.at(0).forEachAtom(onAtom);
+                if (!onFloatingEmbedding(args.at(0), onEmbedding))
+                    accum = sumRowAtoms(args.at(0), num_cols, ts);
 
                 if(num_cols > 0)
                     return ExpressionValue(accum / num_cols, ts);
@@ -2129,26 +2441,7 @@ BoundFunction horizontal_min(const std::vector<BoundSqlExpression> & args)
     return {[=] (const std::vector<ExpressionValue> & args,
                  const SqlRowScope & scope) -> ExpressionValue
             {
-                CellValue min_val;
-                Date ts = Date::negativeInfinity();
-
-                auto onAtom = [&] (const Path & columnName,
-                                   const Path & prefix,
-                                   const CellValue & val,
-                                   Date atomTs)
-                    {
-                        if (!val.empty()) {
-                            if(min_val.empty() || val < min_val) {
-                                ts = atomTs;
-                                min_val = val;
-                            }
-                        }
-                        return true;
-                    };
-
-                args.at(0).forEachAtom(onAtom);
-
-                return ExpressionValue(min_val, ts);
+                return horizontalExtreme<false>(args.at(0));
             },
             std::make_shared<AnyValueInfo>()};
 }
@@ -2161,26 +2454,7 @@ BoundFunction horizontal_max(const std::vector<BoundSqlExpression> & args)
     return {[=] (const std::vector<ExpressionValue> & args,
                  const SqlRowScope & scope) -> ExpressionValue
             {
-                CellValue max_val;
-                Date ts = Date::negativeInfinity();
-
-                auto onAtom = [&] (const Path & columnName,
-                                   const Path & prefix,
-                                   const CellValue & val,
-                                   Date atomTs)
-                    {
-                        if (!val.empty()) {
-                            if(max_val.empty() || val > max_val) {
-                                ts = atomTs;
-                                max_val = val;
-                            }
-                        }
-                        return true;
-                    };
-
-                args.at(0).forEachAtom(onAtom);
-
-                return ExpressionValue(max_val, ts);
+                return horizontalExtreme<true>(args.at(0));
             },
             std::make_shared<AnyValueInfo>()};
 }
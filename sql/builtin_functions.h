@@ -100,6 +100,18 @@ unpackJson(RowValue & row,
 
 typedef BoundFunction (*BuiltinFunction) (const std::vector<BoundSqlExpression> &);
 
+/** Record that the builtin function with the given name may return a
+    different result each time it's called with the same arguments.  This
+    is done by RegisterBuiltin for NON_DETERMINISTIC functions.
+*/
+void noteNonDeterministicBuiltin(const Utf8String & name);
+
+/** Return whether the builtin function with the given name was registered
+    as NON_DETERMINISTIC (for example now()), in which case the result of
+    a query that calls it can't be reused.
+*/
+bool isNonDeterministicBuiltin(const Utf8String & name);
+
 struct RegisterBuiltin {
 
     enum Determinism {
@@ -157,6 +169,7 @@ struct RegisterBuiltin {
                     }
 
                     result.resultInfo = result.resultInfo->getConst(constantArgs && determinism == DETERMINISTIC);
+                    result.deterministic = determinism == DETERMINISTIC;
 
                     return result;
                 } MLDB_CATCH_ALL {
@@ -167,6 +180,8 @@ struct RegisterBuiltin {
                 }
             };
         handles.push_back(registerFunction(Utf8String(name), fn));
+        if (determinism == NON_DETERMINISTIC)
+            noteNonDeterministicBuiltin(name);
         doRegister(function, std::forward<Names>(names)...);
     }
 
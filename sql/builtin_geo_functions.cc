@@ -6,12 +6,16 @@
 */
 
 #include "mldb/sql/builtin_functions.h"
+#include "mldb/sql/builtin_geo_functions.h"
+#include "mldb/ext/s2geometry/src/s2/s2cap.h"
 #include "mldb/ext/s2geometry/src/s2/s2latlng.h"
+#include "mldb/ext/s2geometry/src/s2/s2latlng_rect.h"
 #include "mldb/ext/s2geometry/src/s2/s2polygon.h"
 #include "mldb/ext/s2geometry/src/s2/s2loop.h"
 #include "mldb/ext/s2geometry/src/s2/s2builder.h"
 #include "mldb/ext/s2geometry/src/s2/s2builderutil_s2polygon_layer.h"
 #include "mldb/types/basic_value_descriptions.h"
+#include <cmath>
 
 
 using namespace std;
@@ -68,201 +72,207 @@ BoundFunction geo_distance(const std::vector<BoundSqlExpression> & args)
 
 static RegisterBuiltin registerGeoDistance(geo_distance, "geo_distance");
 
-BoundFunction st_contains(const std::vector<BoundSqlExpression> & args)
+/** Parse the GeoJSON Polygon or MultiPolygon geometry into poly. */
+static void buildGeoJsonPolygon(const ExpressionValue & geometry,
+                                S2Polygon & poly)
 {
-    checkArgsSize(args.size(), 3, __FUNCTION__);
-
-    auto outputInfo
-        = std::make_shared<BooleanValueInfo>();
+    auto getCol = [] (const ExpressionValue & eVal,
+                      const PathElement & columnName,
+                      ExpressionValue & storage)
+        -> const ExpressionValue &
+        {
+            const ExpressionValue * col = eVal.tryGetColumn(columnName,
+                                                            storage);
+            if (!col) {
+                throw MLDB::Exception("Cound not find required column '"+
+                                      columnName.toUtf8String().rawString()+"'");
+            }
+            return *col;
+        };
     
-    return {[=] (const std::vector<ExpressionValue> & args,
-                 const SqlRowScope & scope) -> ExpressionValue
-    {
-      //
-        checkArgsSize(args.size(), 3);
+    if(!geometry.isRow()) {
+        throw MLDB::Exception("argument 1 must be a row representing a GeoJson geometry");
+    }
 
-        auto getCol = [] (const ExpressionValue & eVal,
-                          const PathElement & columnName,
-                          ExpressionValue & storage)
-            -> const ExpressionValue &
-            {
-                const ExpressionValue * col = eVal.tryGetColumn(columnName,
-                                                                storage);
-                if (!col) {
-                    throw MLDB::Exception("Cound not find required column '"+
-                                          columnName.toUtf8String().rawString()+"'");
-                }
-                return *col;
-            };
-        
-        if(!args[0].isRow()) {
-            throw MLDB::Exception("argument 1 must be a row representing a GeoJson geometry");
-        }
+    //cerr << "parsing geometry " << geometry.extractJson() << endl;
+    
+    // GeoJson should have a type key telling us we are dealing
+    // with a polygon
+    ExpressionValue typeStorage;
+    const ExpressionValue & typeCol = getCol(geometry, "type", typeStorage);
 
-        //cerr << "parsing geometry " << args[0].extractJson() << endl;
-        
-        // GeoJson should have a type key telling us we are dealing
-        // with a polygon
-        ExpressionValue typeStorage;
-        const ExpressionValue & typeCol = getCol(args[0], "type", typeStorage);
+    string geomType = typeCol.getAtom().toString();
+    if(geomType != "Polygon" && geomType != "MultiPolygon")
+        throw MLDB::Exception("unknown polygon type: " + geomType);
 
-        string geomType = typeCol.getAtom().toString();
-        if(geomType != "Polygon" && geomType != "MultiPolygon")
-            throw MLDB::Exception("unknown polygon type: " + geomType);
+    //cerr << "geo type is " << geomType << endl;
 
-        //cerr << "geo type is " << geomType << endl;
+    ExpressionValue coordsStorage;
+    const ExpressionValue & coordsCol = getCol(geometry, "coordinates",
+                                               coordsStorage);
 
-        ExpressionValue coordsStorage;
-        const ExpressionValue & coordsCol = getCol(args[0], "coordinates",
-                                                   coordsStorage);
+    // Avoid allocations by keeping it here
+    vector<S2Point> points;
 
-        // Avoid allocations by keeping it here
-        vector<S2Point> points;
+    auto parsePolygon = [&points]
+        (S2Builder & polyBuilder,
+         const ExpressionValue& coords)
+    {
+        //cerr << "parsePolygon " << coords.extractJson() << endl;
 
-        auto parsePolygon = [&points]
-            (S2Builder & polyBuilder,
-             const ExpressionValue& coords)
+        auto onCol = [&] (const PathElement & el,
+                          const ExpressionValue & coordi) -> bool
         {
-            //cerr << "parsePolygon " << coords.extractJson() << endl;
+            size_t numPt = coordi.rowLength();
+            points.clear();
+            points.reserve(numPt);
 
-            auto onCol = [&] (const PathElement & el,
-                              const ExpressionValue & coordi) -> bool
+            std::function<bool (const PathElement & columnName,
+                                const ExpressionValue & val)>
+            onPoint = [&] (const PathElement & columnName,
+                           const ExpressionValue & val) -> bool
             {
-                size_t numPt = coordi.rowLength();
-                points.clear();
-                points.reserve(numPt);
-
-                std::function<bool (const PathElement & columnName,
-                                    const ExpressionValue & val)>
-                onPoint = [&] (const PathElement & columnName,
-                               const ExpressionValue & val) -> bool
+                auto extractDouble = [&] (int el) -> double
                 {
-                    auto extractDouble = [&] (int el) -> double
-                    {
-                        ExpressionValue storage;
-                        const ExpressionValue * v
-                        = val.tryGetColumn(el, storage);
-                        if (!v)
-                            throw AnnotatedException
-                                (400, "GeoJSON points should be [lat,long]; got "
-                                 + jsonEncodeStr(val.extractJson()));
-                        return v->getAtom().toDouble();
-                    };
-                    
-                    double lat1 = extractDouble(1);
-                    double lon1 = extractDouble(0);
-                    
-                    points.emplace_back(S2LatLng::FromDegrees(lat1, lon1)
-                                        .Normalized().ToPoint());
-                        
-                    // Don't add a degenerate point
-                    if (points.size() > 1
-                        && points.back() == points[points.size() - 2])
-                        points.pop_back();
-
-                    return true;
+                    ExpressionValue storage;
+                    const ExpressionValue * v
+                    = val.tryGetColumn(el, storage);
+                    if (!v)
+                        throw AnnotatedException
+                            (400, "GeoJSON points should be [lat,long]; got "
+                             + jsonEncodeStr(val.extractJson()));
+                    return v->getAtom().toDouble();
                 };
-
-                coordi.forEachColumn(onPoint);
                 
-                // Loop is implicitly closed, so if it's explicitly closed
-                // remove the last value
-                if (!points.empty() && points.front() == points.back())
+                double lat1 = extractDouble(1);
+                double lon1 = extractDouble(0);
+                
+                points.emplace_back(S2LatLng::FromDegrees(lat1, lon1)
+                                    .Normalized().ToPoint());
+                    
+                // Don't add a degenerate point
+                if (points.size() > 1
+                    && points.back() == points[points.size() - 2])
                     points.pop_back();
 
-                //cerr << "loop has " << points.size() << " points" << endl;
+                return true;
+            };
 
-                // It's not possible to define a polygon with less than three
-                // edges; this will cause an exception if we let it pass but
-                // occurs in the wild.
-                if (points.size() < 3)
-                    return true;
-                
-                S2Loop loop(points);
-
-                S2Error error;
-                if (loop.FindValidationError(&error)) {
-                    // Note that there may be some points filtered out
-                    cerr << "error in loop: " << error.text() << endl;
-                    cerr << "points.size() = " << points.size() << endl;
-                    cerr << coords.extractJson() << endl;
-
-                    //throw AnnotatedException
-                    //    (400, "Error interpreting GeoJson polygon: S2: "
-                    //     + error.text(),
-                    //     "coordinates", coords.extractJson(),
-                    //     "numDistinctPointsExcludingDuplicates",
-                    //     points.size());                    
-                }
-                
-                // https://tools.ietf.org/html/rfc7946#section-3.1.6
-                // Anything apart from the first is interior, ie a hole
-                // in the first.  This makes it depth one.
-                if(el.toIndex()>0) 
-                    loop.set_depth(1);
-
-                //cerr << "valid = " << loop.IsValid() << endl;
-                //cerr << "normalized = " << loop.IsNormalized() << endl;
-                //cerr << "area = " << loop.GetArea() << endl;
-
-                // Many in the wild geo-JSON files don't respect exct orders
-                loop.Normalize();
-                
-                polyBuilder.AddLoop(std::move(loop));
+            coordi.forEachColumn(onPoint);
+            
+            // Loop is implicitly closed, so if it's explicitly closed
+            // remove the last value
+            if (!points.empty() && points.front() == points.back())
+                points.pop_back();
 
+            //cerr << "loop has " << points.size() << " points" << endl;
+
+            // It's not possible to define a polygon with less than three
+            // edges; this will cause an exception if we let it pass but
+            // occurs in the wild.
+            if (points.size() < 3)
                 return true;
-            };
+            
+            S2Loop loop(points);
+
+            S2Error error;
+            if (loop.FindValidationError(&error)) {
+                // Note that there may be some points filtered out
+                cerr << "error in loop: " << error.text() << endl;
+                cerr << "points.size() = " << points.size() << endl;
+                cerr << coords.extractJson() << endl;
+
+                //throw AnnotatedException
+                //    (400, "Error interpreting GeoJson polygon: S2: "
+                //     + error.text(),
+                //     "coordinates", coords.extractJson(),
+                //     "numDistinctPointsExcludingDuplicates",
+                //     points.size());                    
+            }
+            
+            // https://tools.ietf.org/html/rfc7946#section-3.1.6
+            // Anything apart from the first is interior, ie a hole
+            // in the first.  This makes it depth one.
+            if(el.toIndex()>0) 
+                loop.set_depth(1);
+
+            //cerr << "valid = " << loop.IsValid() << endl;
+            //cerr << "normalized = " << loop.IsNormalized() << endl;
+            //cerr << "area = " << loop.GetArea() << endl;
+
+            // Many in the wild geo-JSON files don't respect exct orders
+            loop.Normalize();
+            
+            polyBuilder.AddLoop(std::move(loop));
 
-            coords.forEachColumn(onCol);
+            return true;
         };
 
-        S2Builder::Options options;
-        S2Builder polyBuilder(options);
-        S2Polygon poly;
-        polyBuilder.StartLayer
-            (absl::make_unique<s2builderutil::S2PolygonLayer>(&poly));
+        coords.forEachColumn(onCol);
+    };
 
-        if(geomType == "Polygon") {
-            parsePolygon(polyBuilder, coordsCol);
-        }
-        else if(geomType == "MultiPolygon") {
+    S2Builder::Options options;
+    S2Builder polyBuilder(options);
+    polyBuilder.StartLayer
+        (absl::make_unique<s2builderutil::S2PolygonLayer>(&poly));
 
-            std::function<bool (const PathElement & columnName,
-                                const ExpressionValue & val)>
-            onPolygon = [&] (const PathElement & columnName,
-                             const ExpressionValue & val) -> bool
-            {
-                S2Builder multiPolyBuilder(options);                
-                S2Polygon poly;
-                multiPolyBuilder.StartLayer
-                    (absl::make_unique<s2builderutil::S2PolygonLayer>(&poly));
-                parsePolygon(multiPolyBuilder, val);
+    if(geomType == "Polygon") {
+        parsePolygon(polyBuilder, coordsCol);
+    }
+    else if(geomType == "MultiPolygon") {
 
-                S2Error error;
-                if (!multiPolyBuilder.Build(&error)) {
-                    throw MLDB::Exception("unable to assemble polygon: "
-                                          + error.text());
-                }
+        std::function<bool (const PathElement & columnName,
+                            const ExpressionValue & val)>
+        onPolygon = [&] (const PathElement & columnName,
+                         const ExpressionValue & val) -> bool
+        {
+            S2Builder multiPolyBuilder(options);                
+            S2Polygon poly;
+            multiPolyBuilder.StartLayer
+                (absl::make_unique<s2builderutil::S2PolygonLayer>(&poly));
+            parsePolygon(multiPolyBuilder, val);
 
-                polyBuilder.AddPolygon(std::move(poly));
+            S2Error error;
+            if (!multiPolyBuilder.Build(&error)) {
+                throw MLDB::Exception("unable to assemble polygon: "
+                                      + error.text());
+            }
 
-                return true;
-            };
+            polyBuilder.AddPolygon(std::move(poly));
+
+            return true;
+        };
 
-            coordsCol.forEachColumn(onPolygon);
+        coordsCol.forEachColumn(onPolygon);
 
-            
-        }
-        else {
-            ExcAssert(false); //tested above
-        }
-        
-        S2Error error;
-        if (!polyBuilder.Build(&error)) {
-            throw MLDB::Exception("unable to assemble polygon: "
-                                  + error.text());
-        }
         
+    }
+    else {
+        ExcAssert(false); //tested above
+    }
+    
+    S2Error error;
+    if (!polyBuilder.Build(&error)) {
+        throw MLDB::Exception("unable to assemble polygon: "
+                              + error.text());
+    }
+}
+
+BoundFunction st_contains(const std::vector<BoundSqlExpression> & args)
+{
+    checkArgsSize(args.size(), 3, __FUNCTION__);
+
+    auto outputInfo
+        = std::make_shared<BooleanValueInfo>();
+    
+    return {[=] (const std::vector<ExpressionValue> & args,
+                 const SqlRowScope & scope) -> ExpressionValue
+    {
+        checkArgsSize(args.size(), 3);
+
+        S2Polygon poly;
+        buildGeoJsonPolygon(args[0], poly);
+
         double lat1 = args[1].getAtom().toDouble();
         double lon1 = args[2].getAtom().toDouble();
 
@@ -282,5 +292,55 @@ BoundFunction st_contains(const std::vector<BoundSqlExpression> & args)
 static RegisterBuiltin registerST_Contains(st_contains, "ST_Contains_Point");
 
 } // namespace Builtins
+
+
+/*****************************************************************************/
+/* GEO BOUNDING BOX                                                          */
+/*****************************************************************************/
+
+static GeoBoundingBox toBoundingBox(const S2LatLngRect & rect)
+{
+    GeoBoundingBox result;
+    if (rect.is_empty()) {
+        result.empty = true;
+        return result;
+    }
+
+    result.minLat = rect.lat_lo().degrees();
+    result.maxLat = rect.lat_hi().degrees();
+    if (!rect.lng().is_full()) {
+        result.minLon = rect.lng_lo().degrees();
+        result.maxLon = rect.lng_hi().degrees();
+    }
+    return result;
+}
+
+GeoBoundingBox getGeoDistanceBounds(double lat, double lon,
+                                    double distanceMeters)
+{
+    if (!std::isfinite(lat) || !std::isfinite(lon) || !(distanceMeters >= 0)) {
+        GeoBoundingBox result;
+        result.empty = true;
+        return result;
+    }
+
+    S2LatLng center = S2LatLng::FromDegrees(lat, lon).Normalized();
+
+    // Slightly bigger, so that rounding doesn't leave out a point that
+    // geo_distance() puts right on the edge
+    double radians
+        = distanceMeters / Builtins::EARTH_MEAN_RADIUS_METERS * (1 + 1e-9)
+        + 1e-12;
+    S2Cap cap(center.ToPoint(), S1Angle::Radians(radians));
+    return toBoundingBox(cap.GetRectBound());
+}
+
+GeoBoundingBox getGeoJsonBounds(const ExpressionValue & geometry)
+{
+    S2Polygon poly;
+    Builtins::buildGeoJsonPolygon(geometry, poly);
+    return toBoundingBox(poly.GetRectBound());
+}
+
 } // namespace MLDB
 
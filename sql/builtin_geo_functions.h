@@ -0,0 +1,44 @@
+/** builtin_geo_functions.h                                         -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Bounds of the regions that the geographical functions test points
+    against, so that the points can be looked up in a spatial index.
+*/
+
+#pragma once
+
+
+namespace MLDB {
+
+struct ExpressionValue;
+
+
+/*****************************************************************************/
+/* GEO BOUNDING BOX                                                          */
+/*****************************************************************************/
+
+/** A box of latitude and longitude, in degrees, with the longitude between
+    -180 and 180.  If minLon > maxLon, the box crosses the antimeridian.
+*/
+struct GeoBoundingBox {
+    double minLat = -90;
+    double maxLat = 90;
+    double minLon = -180;
+    double maxLon = 180;
+
+    /// True if no point is in the box
+    bool empty = false;
+};
+
+/** Return a box that contains every point for which geo_distance() to the
+    given point is at most the given distance in meters.
+*/
+GeoBoundingBox getGeoDistanceBounds(double lat, double lon,
+                                    double distanceMeters);
+
+/** Return a box that contains every point for which ST_Contains_Point() is
+    true for the given GeoJSON geometry.
+*/
+GeoBoundingBox getGeoJsonBounds(const ExpressionValue & geometry);
+
+} // namespace MLDB
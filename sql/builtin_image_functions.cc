@@ -8,6 +8,8 @@
 #include "mldb/ext/easyexif/exif.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/core/value_function.h"
+#include "mldb/sql/image_decoding.h"
+#include "mldb/base/parallel.h"
 
 using namespace std;
 
@@ -207,6 +209,97 @@ BoundFunction extract_exif(const std::vector<BoundSqlExpression> & args)
 
 static RegisterBuiltin registerExtractExif(extract_exif, "parse_exif");
 
+/** Return the blob in the value, which must be an atom. */
+static const CellValue & getImageBlob(const ExpressionValue & val)
+{
+    if (!val.isAtom() || !val.getAtom().isBlob())
+        throw AnnotatedException(400, "decode_jpeg requires a BLOB with the "
+                                 "JPEG image, or a row or embedding of them");
+    return val.getAtom();
+}
+
+/** Decode a JPEG image into an embedding of bytes.  A row or embedding of
+    images is decoded in parallel into a single embedding, with one image
+    per element of its first dimension, in which case they all need to be
+    resized to the same size.
+*/
+ExpressionValue decode_jpeg(const std::vector<ExpressionValue> & args,
+                            const SqlRowScope & scope)
+{
+    checkArgsSize(args.size(), 1, 4, "decode_jpeg");
+
+    if (args[0].empty())
+        return ExpressionValue::null(args[0].getEffectiveTimestamp());
+
+    ImageSize size;
+    size.width = getArg(args, 1, "width", 0).toInt();
+    size.height = getArg(args, 2, "height", 0).toInt();
+    int channels = getArg(args, 3, "channels", 3).toInt();
+
+    if (size.width < 0 || size.height < 0
+        || (size.width == 0) != (size.height == 0))
+        throw AnnotatedException(400, "decode_jpeg width and height must "
+                                 "either both be positive or both be omitted");
+    if (channels != 1 && channels != 3)
+        throw AnnotatedException(400, "decode_jpeg channels must be 1 "
+                                 "(grayscale) or 3 (RGB)");
+
+    Date ts = args[0].getEffectiveTimestamp();
+
+    if (args[0].isAtom()) {
+        const CellValue & blob = getImageBlob(args[0]);
+        if (size.width == 0)
+            size = getJpegSize(blob.blobData(), blob.blobLength());
+
+        DimsVector shape{(size_t)size.height, (size_t)size.width,
+                         (size_t)channels};
+        auto buf = allocateStorageBuffer(shape, ST_UINT8);
+        decodeJpeg(blob.blobData(), blob.blobLength(), size, channels,
+                   (uint8_t *)buf.get());
+        return ExpressionValue::embedding(ts, buf, ST_UINT8, shape);
+    }
+
+    if (size.width == 0)
+        throw AnnotatedException(400, "decode_jpeg needs a width and height "
+                                 "to decode a row of images");
+
+    std::vector<CellValue> blobs = args[0].getEmbeddingCell();
+    for (auto & b: blobs) {
+        if (!b.isBlob())
+            throw AnnotatedException(400, "decode_jpeg requires a row or "
+                                     "embedding of BLOBs");
+    }
+
+    size_t imageBytes = (size_t)size.height * size.width * channels;
+    DimsVector shape{blobs.size(), (size_t)size.height, (size_t)size.width,
+                     (size_t)channels};
+    auto buf = allocateStorageBuffer(shape, ST_UINT8);
+    uint8_t * out = (uint8_t *)buf.get();
+
+    auto onImage = [&] (size_t i)
+        {
+            decodeJpeg(blobs[i].blobData(), blobs[i].blobLength(), size,
+                       channels, out + i * imageBytes);
+        };
+
+    parallelMap(0, blobs.size(), onImage);
+
+    return ExpressionValue::embedding(ts, buf, ST_UINT8, shape);
+}
+
+BoundFunction bind_decode_jpeg(const std::vector<BoundSqlExpression> & args)
+{
+    checkArgsSize(args.size(), 1, 4, "decode_jpeg");
+
+    return {
+        decode_jpeg,
+        std::make_shared<EmbeddingValueInfo>(std::vector<ssize_t>({-1, -1, -1}),
+                                             ST_UINT8)
+    };
+}
+
+static RegisterBuiltin registerDecodeJpeg(bind_decode_jpeg, "decode_jpeg");
+
 
 
 } // namespace Builtins
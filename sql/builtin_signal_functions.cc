@@ -13,6 +13,9 @@
 #include "mldb/utils/possibly_dynamic_buffer.h"
 #include "mldb/types/annotated_exception.h"
 #include "mldb/arch/simd_vector.h"
+#include "mldb/base/parallel.h"
+#include <map>
+#include <mutex>
 
 using namespace std;
 
@@ -21,198 +24,406 @@ using namespace std;
 namespace MLDB {
 namespace Builtins {
 
-ExpressionValue fft(const std::vector<ExpressionValue> & args,
-                    const SqlRowScope & scope)
-{
-    checkArgsSize(args.size(), 1, 3, "fft");
+/*****************************************************************************/
+/* FFT PLANS                                                                 */
+/*****************************************************************************/
 
-    if (args[0].empty() || args[1].empty()) {
-        return ExpressionValue::null(calcTs(args[0], args[1]));
+/** A pffft setup for one length and type of transform, which holds its
+    twiddle factors.  Transforms only read it, so one plan is shared by
+    every row and thread that needs it.
+*/
+struct FftPlan {
+    FftPlan(size_t n, pffft_transform_t type)
+        : n(n), setup(pffft_new_setup(n, type))
+    {
+        if (!setup) {
+            throw AnnotatedException(400, "Couldn't setup fft transform for size "
+                                      + to_string(n));
+        }
     }
 
-    Utf8String directionStr
-        = getArg(args, 1, "direction", "forward").toUtf8String();
-    pffft_direction_t direction;
-    if (directionStr == "forward")
-        direction = PFFFT_FORWARD;
-    else if (directionStr == "backward")
-        direction = PFFFT_BACKWARD;
-    else throw AnnotatedException(400, "FFT direction must be either 'forward' "
-                                   "or 'backward'; got '" + directionStr
-                                   + "'.");
-
-    pffft_transform_t type;
-
-    Utf8String typeStr = getArg(args, 2, "type", "real").toUtf8String();
-    if (typeStr == "real")
-        type = PFFFT_REAL;
-    else if (typeStr == "complex")
-        type = PFFFT_COMPLEX;
-    else throw AnnotatedException(400, "FFT type must be either 'real' "
-                                   "or 'complex'; got '" + typeStr
-                                   + "'.");
-    
-
+    ~FftPlan()
+    {
+        pffft_destroy_setup(setup);
+    }
 
-    DimsVector dimsVector = args[0].getEmbeddingShape();
+    size_t n;
+    PFFFT_Setup * setup;
+};
 
-    //cerr << "fft " << directionStr << " " << typeStr << " " << dimsVector << endl;
+/// Plans that are kept once they are created.  Beyond this many different
+/// sizes, plans are created for each call.
+static constexpr size_t MAX_CACHED_FFT_PLANS = 64;
 
-    // Either an embedding of size n (real numbers), or an embedding of size
-    // n x 2 (complex numbers).
+/** Return the plan for the given length and type of transform. */
+static std::shared_ptr<const FftPlan>
+getFftPlan(size_t n, pffft_transform_t type)
+{
+    static std::mutex mutex;
+    static std::map<std::pair<size_t, int>, std::shared_ptr<const FftPlan> >
+        plans;
 
-    if (dimsVector.size() != 1
-        && !(dimsVector.size() == 2 && dimsVector[1] == 2)) {
-        throw AnnotatedException(400, "FFT requires either a flat embedding "
-                                  "for real numbers, or a nx2 embedding for "
-                                  "complex numbers.");
-    }
+    auto key = std::make_pair(n, (int)type);
 
-    size_t nel = std::accumulate(dimsVector.begin(), dimsVector.end(), (size_t)1,
-                                 std::multiplies<size_t>());
-    
-    if (nel % 32 != 0) {
-        // Comments from pffft.c:
-        /* unfortunately, the fft size must be a multiple of 16 for complex FFTs 
-           and 32 for real FFTs -- a lot of stuff would need to be rewritten to
-           handle other cases (or maybe just switch to a scalar fft, I don't know..) */
-        //if (transform == PFFFT_REAL) { assert((N%(2*SIMD_SZ*SIMD_SZ))==0 && N>0); }
-        //assert((N % 32) == 0);
-
-        throw AnnotatedException(400, "FFT size must be a multiple of 32");
-    }
+    std::unique_lock<std::mutex> guard(mutex);
+    auto it = plans.find(key);
+    if (it != plans.end())
+        return it->second;
 
-    size_t n = dimsVector[0];
+    auto plan = std::make_shared<const FftPlan>(n, type);
+    if (plans.size() < MAX_CACHED_FFT_PLANS)
+        plans[key] = plan;
+    return plan;
+}
 
-    if (dimsVector.size() == 1) {
-        // Real valued input
-        // This gives a complex output that is symmetrical about the mid
-        // point of the range
+/** Allocate a buffer of floats aligned as pffft requires. */
+static std::shared_ptr<float> allocateFftBuffer(size_t n)
+{
+    float * data = (float *)pffft_aligned_malloc(n * sizeof(float));
+    if (!data && n != 0)
+        throw std::bad_alloc();
+    return std::shared_ptr<float>(data, [] (float * p) { pffft_aligned_free(p); });
+}
 
-        if (direction != PFFFT_FORWARD || type != PFFFT_REAL) {
-            throw AnnotatedException
-                (400, "Complex input is required for inverse or complex fft");
+/** Return the scratch space of the calling thread for a transform of the
+    given number of floats, which is kept from one call to the next.
+*/
+static float * getFftWorkspace(size_t n)
+{
+    struct Workspace {
+        ~Workspace()
+        {
+            pffft_aligned_free(data);
         }
 
-        PFFFT_Setup * setup = pffft_new_setup(n, type);
+        float * data = nullptr;
+        size_t size = 0;
+    };
 
-        if (!setup) {
-            throw AnnotatedException(400, "Couldn't setup fft transform for size "
-                                      + to_string(dimsVector[0]));
-        }
-        Scope_Exit(pffft_destroy_setup(setup));
+    static thread_local Workspace workspace;
+    if (workspace.size < n) {
+        pffft_aligned_free(workspace.data);
+        workspace.data = nullptr;
+        workspace.size = 0;
+        workspace.data = (float *)pffft_aligned_malloc(n * sizeof(float));
+        if (!workspace.data)
+            throw std::bad_alloc();
+        workspace.size = n;
+    }
+    return workspace.data;
+}
 
-        // Pffft
-        PossiblyDynamicBuffer<float> workspace(n + 3);
+/** Return the elements of an embedding as floats, without copying them if
+    they are already stored as floats.
+*/
+static std::shared_ptr<const float>
+getFftInput(const ExpressionValue & val, size_t nel)
+{
+    if (val.getEmbeddingType() == ST_FLOAT32)
+        return std::static_pointer_cast<const float>(val.getEmbeddingData());
+    auto result = allocateFftBuffer(nel);
+    val.convertEmbedding(result.get(), nel, ST_FLOAT32);
+    return result;
+}
 
-        // Get a 16 byte aligned buffer
-        float * tmp = workspace.data();
-        while (((size_t)tmp & 15) != 0)
-            ++tmp;
+/** Transform numSignals signals of signalFloats floats each with the plan.
+    Signal i is read from input + i * inputStride and written contiguously
+    to output.  Signals that aren't aligned as pffft requires are copied to
+    the output first and transformed in place.  Large batches of signals
+    are transformed in parallel.
+*/
+static void runFfts(const FftPlan & plan, pffft_direction_t direction,
+                    const float * input, size_t inputStride,
+                    float * output, size_t numSignals, size_t signalFloats)
+{
+    auto doSignals = [&] (size_t first, size_t last)
+        {
+            float * work = getFftWorkspace(signalFloats);
+            for (size_t i = first;  i < last;  ++i) {
+                const float * in = input + i * inputStride;
+                float * out = output + i * signalFloats;
+                if (((size_t)in & 15) != 0) {
+                    std::copy(in, in + signalFloats, out);
+                    in = out;
+                }
+                pffft_transform_ordered(plan.setup, in, out, work, direction);
+            }
+        };
 
-        std::shared_ptr<float>
-            data((float *)pffft_aligned_malloc(n * 2 * sizeof(float)),
-                 [] (float * p) {pffft_aligned_free(p); });
-    
-        args[0].convertEmbedding(data.get(), n, ST_FLOAT32);
-    
-        pffft_transform_ordered(setup, data.get(), data.get(), tmp,
-                                direction);
-        
-        // From pffft.h
-        // (for real transforms, both 0-frequency and half frequency
-        // components, which are real, are assembled in the first entry as
-        // F(0)+i*F(n/2+1). Note that the original fftpack did place
-        // F(n/2+1) at the end of the arrays).
-        //data.get()[1] = 0;
-
-        // We have two columns: one with the real, the other with the
-        // imaginary.
-        DimsVector newShape({n/2, 2});
-        
-        return ExpressionValue::embedding(args[0].getEffectiveTimestamp(),
-                                          data, ST_FLOAT32, newShape);
+    static constexpr size_t PARALLEL_FFT_FLOATS = 1 << 16;
+
+    if (numSignals > 1 && numSignals * signalFloats >= PARALLEL_FFT_FLOATS) {
+        size_t chunkSize
+            = std::max<size_t>(1, PARALLEL_FFT_FLOATS / 4 / signalFloats);
+        parallelMapChunked(0, numSignals, chunkSize, doSignals);
     }
-    else {
-        // Complex input, n x 2
-        if (type == PFFFT_REAL) {
-            n *= 2;   // fft of real n -> n/2 x 2, so ifft of n x 2 -> n*2
-        }
+    else doSignals(0, numSignals);
+}
 
-        PFFFT_Setup * setup = pffft_new_setup(n, type);
+static pffft_direction_t getFftDirection(const CellValue & val)
+{
+    Utf8String directionStr = val.toUtf8String();
+    if (directionStr == "forward")
+        return PFFFT_FORWARD;
+    else if (directionStr == "backward")
+        return PFFFT_BACKWARD;
+    else throw AnnotatedException(400, "FFT direction must be either 'forward' "
+                                   "or 'backward'; got '" + directionStr
+                                   + "'.");
+}
 
-        if (!setup) {
-            throw AnnotatedException(400, "Couldn't setup complex fft transform for size "
-                                      + to_string(n));
+static pffft_transform_t getFftType(const CellValue & val)
+{
+    Utf8String typeStr = val.toUtf8String();
+    if (typeStr == "real")
+        return PFFFT_REAL;
+    else if (typeStr == "complex")
+        return PFFFT_COMPLEX;
+    else throw AnnotatedException(400, "FFT type must be either 'real' "
+                                   "or 'complex'; got '" + typeStr
+                                   + "'.");
+}
+
+/** How the embedding passed to fft() is split into signals, and the shape
+    of the result.
+*/
+struct FftShape {
+    FftShape(const DimsVector & dims, pffft_direction_t direction,
+             pffft_transform_t type)
+    {
+        // Either an embedding of size n (real numbers), or an embedding of
+        // size n x 2 (complex numbers), optionally with a leading dimension
+        // with one for each of a batch of signals.  As FFT sizes are
+        // multiples of 32, n x 2 can't be a batch of real signals.
+        bool complex = dims.size() >= 2 && dims.back() == 2;
+        size_t signalDims = complex ? 2 : 1;
+        if (dims.size() != signalDims && dims.size() != signalDims + 1) {
+            throw AnnotatedException(400, "FFT requires either a flat embedding "
+                                      "for real numbers, or a nx2 embedding for "
+                                      "complex numbers, optionally with a "
+                                      "leading dimension for a batch of them.");
         }
-        Scope_Exit(pffft_destroy_setup(setup));
 
-        PossiblyDynamicBuffer<float> workspace((n*2) + 3);
+        batched = dims.size() > signalDims;
+        numSignals = batched ? dims[0] : 1;
+        size_t len = dims[batched];
+        signalFloats = len * signalDims;
 
-        // Get a 16 byte aligned buffer
-        float * tmp = workspace.data();
-        while (((size_t)tmp & 15) != 0)
-            ++tmp;
+        if (signalFloats % 32 != 0) {
+            // Comments from pffft.c:
+            /* unfortunately, the fft size must be a multiple of 16 for complex FFTs 
+               and 32 for real FFTs -- a lot of stuff would need to be rewritten to
+               handle other cases (or maybe just switch to a scalar fft, I don't know..) */
+            //if (transform == PFFFT_REAL) { assert((N%(2*SIMD_SZ*SIMD_SZ))==0 && N>0); }
+            //assert((N % 32) == 0);
 
-        std::shared_ptr<float>
-            data((float *)pffft_aligned_malloc(nel * sizeof(float)),
-                 [] (float * p) {pffft_aligned_free(p); });
-    
-        args[0].convertEmbedding(data.get(), nel, ST_FLOAT32);
-    
-        pffft_transform_ordered(setup, data.get(), data.get(), tmp,
-                                direction);
+            throw AnnotatedException(400, "FFT size must be a multiple of 32");
+        }
+
+        if (!complex) {
+            // Real valued input
+            // This gives a complex output that is symmetrical about the mid
+            // point of the range
+            if (direction != PFFFT_FORWARD || type != PFFFT_REAL) {
+                throw AnnotatedException
+                    (400, "Complex input is required for inverse or complex fft");
+            }
+            planLength = len;
 
-        DimsVector newShape;
-        size_t numToScale;
-        if (direction == PFFFT_FORWARD || type == PFFFT_COMPLEX) {
             // We have two columns: one with the real, the other with the
             // imaginary.
-            newShape = {n, 2};
-            numToScale = n * 2;
+            outputShape = { len / 2, 2 };
         }
         else {
-            newShape = { n };
-            numToScale = n;
+            // fft of real n -> n/2 x 2, so ifft of n x 2 -> n*2
+            planLength = type == PFFFT_REAL ? len * 2 : len;
+
+            if (direction == PFFFT_FORWARD || type == PFFFT_COMPLEX) {
+                outputShape = { signalFloats / 2, 2 };
+            }
+            else {
+                outputShape = { signalFloats };
+            }
         }
 
-        if (direction == PFFFT_BACKWARD) {
-            // The ifft doesn't rescale, so we do so here in order to
-            // ensure that ifft(fft(x)) = x
-            SIMD::vec_scale(data.get(), 1.0 / n, data.get(), numToScale);
-        }
-        
-        return ExpressionValue::embedding(args[0].getEffectiveTimestamp(),
-                                          data, ST_FLOAT32, newShape);
+        if (batched)
+            outputShape.insert(outputShape.begin(), numSignals);
+    }
+
+    bool batched;
+    size_t numSignals;
+    size_t signalFloats;   ///< Number of floats in each signal
+    size_t planLength;     ///< Length of the transform
+    DimsVector outputShape;
+};
+
+/** Transform the embedding, which is a signal or a batch of signals. */
+static ExpressionValue
+runFft(const ExpressionValue & input,
+       pffft_direction_t direction, pffft_transform_t type)
+{
+    FftShape shape(input.getEmbeddingShape(), direction, type);
+    size_t nel = shape.numSignals * shape.signalFloats;
+
+    auto plan = getFftPlan(shape.planLength, type);
+    auto inputData = getFftInput(input, nel);
+    auto data = allocateFftBuffer(nel);
+
+    runFfts(*plan, direction, inputData.get(), shape.signalFloats,
+            data.get(), shape.numSignals, shape.signalFloats);
+
+    // From pffft.h
+    // (for real transforms, both 0-frequency and half frequency
+    // components, which are real, are assembled in the first entry as
+    // F(0)+i*F(n/2+1). Note that the original fftpack did place
+    // F(n/2+1) at the end of the arrays).
+    //data.get()[1] = 0;
+
+    if (direction == PFFFT_BACKWARD) {
+        // The ifft doesn't rescale, so we do so here in order to
+        // ensure that ifft(fft(x)) = x
+        SIMD::vec_scale(data.get(), 1.0 / shape.planLength, data.get(), nel);
     }
+
+    return ExpressionValue::embedding(input.getEffectiveTimestamp(),
+                                      data, ST_FLOAT32, shape.outputShape);
 }
 
-BoundFunction bind_fft(const std::vector<BoundSqlExpression> & args)
+ExpressionValue fft(const std::vector<ExpressionValue> & args,
+                    const SqlRowScope & scope)
 {
     checkArgsSize(args.size(), 1, 3, "fft");
 
-    if (args[0].info->isEmbedding()) {
-        auto shape
-            = args[0].info->getEmbeddingShape();
+    if (args[0].empty()) {
+        return ExpressionValue::null(args[0].getEffectiveTimestamp());
+    }
 
-        if (shape.size() != 1)
-            throw AnnotatedException(500, "only 1d ffts are supported");
+    pffft_direction_t direction
+        = getFftDirection(getArg(args, 1, "direction", "forward"));
+    pffft_transform_t type = getFftType(getArg(args, 2, "type", "real"));
 
-        return {
-            fft,
-            std::make_shared<EmbeddingValueInfo>(shape, ST_FLOAT32)
-        };
-    }
-    else {
+    return runFft(args[0], direction, type);
+}
+
+BoundFunction bind_fft(const std::vector<BoundSqlExpression> & args)
+{
+    checkArgsSize(args.size(), 1, 3, "fft");
+
+    // The direction and type are almost always constants, in which case
+    // they are parsed once here
+    bool constantOptions = true;
+    for (size_t i = 1;  i < args.size();  ++i)
+        constantOptions = constantOptions && args[i].info->isConst();
+
+    if (!constantOptions) {
         return {
             fft,
             std::make_shared<EmbeddingValueInfo>(ST_FLOAT32) // length unknown
         };
     }
+
+    pffft_direction_t direction
+        = getFftDirection(args.size() > 1
+                          ? args[1].constantValue().getAtom()
+                          : CellValue("forward"));
+    pffft_transform_t type
+        = getFftType(args.size() > 2
+                     ? args[2].constantValue().getAtom()
+                     : CellValue("real"));
+
+    auto outputInfo = std::make_shared<EmbeddingValueInfo>(ST_FLOAT32);
+    if (args[0].info->isEmbedding()) {
+        auto shape = args[0].info->getEmbeddingShape();
+        bool known = !shape.empty();
+        DimsVector dims;
+        for (auto & s: shape) {
+            known = known && s >= 0;
+            dims.push_back(s);
+        }
+        if (known) {
+            FftShape fftShape(dims, direction, type);
+            std::vector<ssize_t> outputShape(fftShape.outputShape.begin(),
+                                             fftShape.outputShape.end());
+            outputInfo = std::make_shared<EmbeddingValueInfo>
+                (outputShape, ST_FLOAT32);
+        }
+    }
+
+    return {
+        [=] (const std::vector<ExpressionValue> & args,
+             const SqlRowScope & scope) -> ExpressionValue
+        {
+            if (args[0].empty()) {
+                return ExpressionValue::null(args[0].getEffectiveTimestamp());
+            }
+            return runFft(args[0], direction, type);
+        },
+        outputInfo
+    };
 }
 
 static RegisterBuiltin registerFft(bind_fft, "fft");
 
+/** Short-time fourier transform: the forward real FFT of each frame of
+    frameLength samples of a real signal, with the frames starting every
+    hop samples.  The frames are read in place, so they don't need to be
+    extracted first.
+*/
+ExpressionValue stft(const std::vector<ExpressionValue> & args,
+                     const SqlRowScope & scope)
+{
+    checkArgsSize(args.size(), 2, 3, "stft");
+
+    if (args[0].empty() || args[1].empty()) {
+        return ExpressionValue::null(calcTs(args[0], args[1]));
+    }
+
+    int64_t frameLength = args[1].getAtom().toInt();
+    int64_t hop = getArg(args, 2, "hop", frameLength).toInt();
+
+    if (frameLength <= 0 || frameLength % 32 != 0)
+        throw AnnotatedException(400, "STFT frame length must be a positive "
+                                 "multiple of 32");
+    if (hop <= 0)
+        throw AnnotatedException(400, "STFT hop must be positive");
+
+    DimsVector dims = args[0].getEmbeddingShape();
+    if (dims.size() != 1)
+        throw AnnotatedException(400, "STFT requires a flat embedding of "
+                                 "real numbers");
+
+    size_t len = dims[0];
+    if (len < frameLength)
+        throw AnnotatedException(400, "STFT frame length is longer than the "
+                                 "signal");
+
+    size_t numFrames = 1 + (len - frameLength) / hop;
+
+    auto plan = getFftPlan(frameLength, PFFFT_REAL);
+    auto inputData = getFftInput(args[0], len);
+    auto data = allocateFftBuffer(numFrames * frameLength);
+
+    runFfts(*plan, PFFFT_FORWARD, inputData.get(), hop,
+            data.get(), numFrames, frameLength);
+
+    DimsVector newShape({numFrames, (size_t)frameLength / 2, 2});
+    return ExpressionValue::embedding(args[0].getEffectiveTimestamp(),
+                                      data, ST_FLOAT32, newShape);
+}
+
+BoundFunction bind_stft(const std::vector<BoundSqlExpression> & args)
+{
+    checkArgsSize(args.size(), 2, 3, "stft");
+
+    return {
+        stft,
+        std::make_shared<EmbeddingValueInfo>(std::vector<ssize_t>({-1, -1, 2}),
+                                             ST_FLOAT32)
+    };
+}
+
+static RegisterBuiltin registerStft(bind_stft, "stft");
+
 ExpressionValue sliceEmbedding(const std::vector<ExpressionValue> & args,
                               const SqlRowScope & scope)
 {
@@ -244,11 +455,10 @@ ExpressionValue sliceEmbedding(const std::vector<ExpressionValue> & args,
 
     auto buf = allocateStorageBuffer(shape, st);
 
-    // TODO: more efficient...
-    auto cells = args[0].getEmbeddingCell();
-
+    // Copy every l-th element straight from the embedding's buffer
+    auto data = args[0].getEmbeddingData();
     for (size_t i = 0;  i < n;  ++i) {
-        fillStorageBuffer(buf.get(), i, st, 1, cells[i * l + p]);
+        copyStorageBuffer(data.get(), i * l + p, st, buf.get(), i, st, 1);
     }
 
     return ExpressionValue
@@ -150,14 +150,7 @@ CellValue(const Path & path)
             type = ST_SHORT_PATH;
         }
         else {
-            // NOTE: once the malloc has succeeded, the rest is
-            // noexcept.
-            void * mem = malloc(sizeof(StringRepr) + strLength);
-            if (!mem)
-                throw std::bad_alloc();
-
-            longString = new (mem) StringRepr;  // placement new noexcept
-            std::copy(p, p + strLength, longString->repr); // copy char noexcept
+            longString = allocateString(p, strLength);
             type = ST_LONG_PATH;
         }
 
@@ -181,9 +174,7 @@ CellValue(const Path & path)
         type = ST_SHORT_PATH;
     }
     else {
-        void * mem = malloc(sizeof(StringRepr) + strLength);
-        longString = new (mem) StringRepr;
-        std::copy(u.rawData(), u.rawData() + strLength, longString->repr);
+        longString = allocateString(u.rawData(), strLength);
         type = ST_LONG_PATH;
     }
 }
@@ -302,10 +293,7 @@ initString(const char * stringValue, size_t len, bool isUtf8, bool check)
         else {
             type = ST_ASCII_LONG_STRING;
         }
-        void * mem = malloc(sizeof(StringRepr) + strLength + 1);
-        longString = new (mem) StringRepr;
-        std::copy(s, e, longString->repr);
-        longString->repr[strLength + 1] = 0;
+        longString = allocateString(s, strLength);
     }
 }
 
@@ -319,27 +307,24 @@ initBlob(const char * data, size_t len)
         type = ST_SHORT_BLOB;
     }
     else {
-        void * mem = malloc(sizeof(StringRepr) + len);
-        longString = new (mem) StringRepr;
-        std::copy(data, data + len, longString->repr);
+        longString = allocateString(data, len);
         type = ST_LONG_BLOB;
     }
 }
 
+CellValue::StringRepr *
 CellValue::
-CellValue(const CellValue & other)
-    : bits1(other.bits1), bits2(other.bits2), flags(other.flags)
+allocateString(const char * data, size_t len)
 {
-    if (other.type == ST_ASCII_LONG_STRING
-        || other.type == ST_UTF8_LONG_STRING
-        || other.type == ST_LONG_BLOB
-        || other.type == ST_LONG_PATH) {
-        void * mem = malloc(sizeof(StringRepr) + other.strLength + 1);
-        longString = new (mem) StringRepr;
-        std::copy(other.longString->repr, other.longString->repr + strLength,
-                  longString->repr);
-        longString->repr[strLength] = 0;
-    }
+    // NOTE: once the malloc has succeeded, the rest is noexcept.
+    void * mem = malloc(sizeof(StringRepr) + len + 1);
+    if (!mem)
+        throw std::bad_alloc();
+
+    StringRepr * result = new (mem) StringRepr;
+    std::copy(data, data + len, result->repr);
+    result->repr[len] = 0;
+    return result;
 }
 
 CellValue
@@ -1001,7 +986,9 @@ operator == (const CellValue & other) const
     case ST_LONG_BLOB:
     case ST_LONG_PATH:
         return strLength == other.strLength
-            && strncmp(longString->repr, other.longString->repr, strLength) == 0;
+            && (longString == other.longString
+                || strncmp(longString->repr, other.longString->repr,
+                           strLength) == 0);
     case ST_TIMESTAMP:
         return toTimestamp() == other.toTimestamp();
     case ST_TIMEINTERVAL: {
@@ -1301,7 +1288,8 @@ void
 CellValue::
 deleteString()
 {
-    if (longString) {
+    if (longString
+        && longString->ref.fetch_sub(1, std::memory_order_acq_rel) == 1) {
         longString->~StringRepr();
         free(longString);
     }
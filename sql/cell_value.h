@@ -94,7 +94,16 @@ struct CellValue {
               StringCharacteristics characteristics = STRING_UNKNOWN);
     CellValue(Date timestampstatic) noexcept;
     
-    CellValue(const CellValue & other);
+    /** Copying shares the payload of long strings, blobs and paths, which
+        is immutable and reference counted, so it never allocates.
+    */
+    MLDB_ALWAYS_INLINE CellValue(const CellValue & other) noexcept
+        : bits1(other.bits1), bits2(other.bits2), flags(other.flags)
+    {
+        if (hasLongString())
+            longString->ref.fetch_add(1, std::memory_order_relaxed);
+    }
+
     MLDB_ALWAYS_INLINE CellValue(CellValue && other) noexcept
         : bits1(other.bits1), bits2(other.bits2), flags(other.flags)
     {
@@ -149,8 +158,7 @@ struct CellValue {
     
     MLDB_ALWAYS_INLINE ~CellValue()
     {
-        if (type == ST_ASCII_LONG_STRING || type == ST_UTF8_LONG_STRING
-            || type == ST_LONG_BLOB)
+        if (hasLongString())
             deleteString();
     }
 
@@ -473,8 +481,18 @@ private:
     /** Initialize a blob. */
     void initBlob(const char * data, size_t len);
 
+    /** Release our reference to the long string payload, freeing it if
+        we were the last user.
+    */
     void deleteString();
 
+    /** Is the payload held in a reference counted StringRepr? */
+    MLDB_ALWAYS_INLINE bool hasLongString() const
+    {
+        return type == ST_ASCII_LONG_STRING || type == ST_UTF8_LONG_STRING
+            || type == ST_LONG_BLOB || type == ST_LONG_PATH;
+    }
+
     std::string printInterval() const;
 
     Utf8String trimmedExceptionString() const;
@@ -501,9 +519,14 @@ private:
         ST_LONG_PATH
     };
 
+    /** Out of line payload for long strings, blobs and paths.  It's never
+        modified once constructed (apart from caching the hash), and so is
+        shared between all copies of a CellValue; ref is the number of
+        CellValues pointing to it.
+    */
     struct StringRepr {
         StringRepr() noexcept
-            : hash(0), ref(0)
+            : hash(0), ref(1)
         {
         }
 
@@ -512,6 +535,11 @@ private:
         char repr[0];
     };
 
+    /** Allocate a StringRepr holding a copy of the len bytes at data, with
+        a single reference.  The representation is null terminated.
+    */
+    static StringRepr * allocateString(const char * data, size_t len);
+
     struct TimeIntervalRepr {
         uint16_t months;
         uint16_t days;
@@ -10,6 +10,8 @@
 #include "mldb/types/annotated_exception.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/utils/smart_ptr_utils.h"
+#include "mldb/sql/query_explain.h"
+#include "mldb/arch/demangle.h"
 #include <algorithm>
 
 
@@ -393,6 +395,83 @@ takeAll(std::function<bool (std::shared_ptr<PipelineResults> &)> onResult)
     return true;
 }
 
+
+/*****************************************************************************/
+/* BOUND PIPELINE ELEMENT                                                    */
+/*****************************************************************************/
+
+namespace {
+
+/** Executor that records the rows output by another, and the time that
+    they took, into a node of the plan of an explained query.
+*/
+struct ExplainedElementExecutor: public ElementExecutor {
+    ExplainedElementExecutor(std::shared_ptr<ElementExecutor> executor,
+                             std::shared_ptr<QueryExplainNode> node)
+        : executor(std::move(executor)), node(std::move(node))
+    {
+    }
+
+    std::shared_ptr<ElementExecutor> executor;
+    std::shared_ptr<QueryExplainNode> node;
+
+    void record(const PipelineResults & result)
+    {
+        ++node->rowsOut;
+        if (!result.values.empty())
+            node->bytes += approxMemusage(result.values.back());
+    }
+
+    virtual std::shared_ptr<PipelineResults> take()
+    {
+        QueryExplainTimer timer(node.get());
+        auto result = executor->take();
+        if (result)
+            record(*result);
+        return result;
+    }
+
+    virtual bool takeAll(std::function<bool (std::shared_ptr<PipelineResults> &)> onResult)
+    {
+        QueryExplainTimer timer(node.get());
+        auto onRecordedResult = [&] (std::shared_ptr<PipelineResults> & result)
+            {
+                record(*result);
+                return onResult(result);
+            };
+        return executor->takeAll(onRecordedResult);
+    }
+
+    virtual void restart()
+    {
+        executor->restart();
+    }
+};
+
+} // file scope
+
+std::shared_ptr<ElementExecutor>
+BoundPipelineElement::
+start(const BoundParameters & getParam) const
+{
+    QueryExplainNode * parent = QueryExplainScope::current();
+    if (!parent)
+        return doStart(getParam);
+
+    // MLDB::FilterWhereElement::Bound becomes FilterWhereElement
+    std::string type = demangle(typeid(*this));
+    if (type.find("MLDB::") == 0)
+        type = type.substr(6);
+    if (type.size() > 7 && type.rfind("::Bound") == type.size() - 7)
+        type.resize(type.size() - 7);
+
+    // Elements started by this one are its children in the plan
+    auto node = parent->addChild(type);
+    QueryExplainScope scope(node);
+    return std::make_shared<ExplainedElementExecutor>(doStart(getParam),
+                                                      node);
+}
+
 /*****************************************************************************/
 /* PIPELINE ELEMENT                                                          */
 /*****************************************************************************/
@@ -549,9 +628,10 @@ select(const TupleExpression & tup)
 
 std::shared_ptr<PipelineElement>
 PipelineElement::
-sort(OrderByExpression orderBy)
+sort(OrderByExpression orderBy, ssize_t maxRows)
 {
-    return std::make_shared<OrderByElement>(shared_from_this(), orderBy);
+    return std::make_shared<OrderByElement>(shared_from_this(), orderBy,
+                                            maxRows);
 }
 
 std::shared_ptr<PipelineElement>
@@ -563,7 +643,8 @@ partition(int numElements)
 
 std::shared_ptr<PipelineElement>
 PipelineElement::
-statement(const SelectStatement& stm, GetParamInfo getParamInfo)
+statement(const SelectStatement& stm, GetParamInfo getParamInfo,
+          ssize_t maxRows)
 {
     auto root = shared_from_this();
 
@@ -591,7 +672,7 @@ statement(const SelectStatement& stm, GetParamInfo getParamInfo)
             ->partition(groupBy.clauses.size())
             ->where(stm.having)
             ->select(stm.orderBy)
-            ->sort(stm.orderBy)
+            ->sort(stm.orderBy, maxRows)
             ->select(stm.rowName)  // second last element is rowname
             ->select(stm.select);
     }
@@ -604,7 +685,7 @@ statement(const SelectStatement& stm, GetParamInfo getParamInfo)
                    OrderByExpression(), getParamInfo)
             ->where(stm.where)
             ->select(stm.orderBy)
-            ->sort(stm.orderBy)
+            ->sort(stm.orderBy, maxRows)
             ->select(stm.rowName)  // second last element is rowname
             ->select(stm.select);
         }
@@ -246,9 +246,16 @@ struct BoundPipelineElement {
     {
     }
 
-    /** Start running the query */
+    /** Start running the query.  If the query is being explained (see
+        query_explain.h), this adds the element to the plan and records
+        the rows and time of its executor.
+    */
+    std::shared_ptr<ElementExecutor>
+    start(const BoundParameters & getParam) const;
+
+    /** Start running the query.  This is what each element implements. */
     virtual std::shared_ptr<ElementExecutor>
-    start(const BoundParameters & getParam) const = 0;
+    doStart(const BoundParameters & getParam) const = 0;
 
     /** Return the scope that describes the output of this element. */
     virtual std::shared_ptr<PipelineExpressionScope>
@@ -370,8 +377,12 @@ struct PipelineElement: public std::enable_shared_from_this<PipelineElement> {
     std::shared_ptr<PipelineElement>
     select(const OrderByExpression & select);
 
+    /** Sort the rows.  If maxRows isn't -1, only the first maxRows rows
+        of the sorted output will be read, so the rest don't need to be
+        kept.
+    */
     std::shared_ptr<PipelineElement>
-    sort(OrderByExpression sortBy);
+    sort(OrderByExpression sortBy, ssize_t maxRows = -1);
 
     std::shared_ptr<PipelineElement>
     select(const TupleExpression & tup);
@@ -388,9 +399,14 @@ struct PipelineElement: public std::enable_shared_from_this<PipelineElement> {
     std::shared_ptr<PipelineElement>
     select(std::shared_ptr<SqlExpression> select);
 
-    // return a pipeline that will execute the specified statement
+    /** Return a pipeline that will execute the specified statement.  The
+        offset and limit of the statement aren't applied by the pipeline.
+        If maxRows isn't -1, only the first maxRows rows of its output will
+        be read, which allows the final sort to keep only those.
+    */
     std::shared_ptr<PipelineElement>
-    statement(const SelectStatement& statement, GetParamInfo getParamInfo);
+    statement(const SelectStatement& statement, GetParamInfo getParamInfo,
+              ssize_t maxRows = -1);
 };
 
 } // namespace MLDB
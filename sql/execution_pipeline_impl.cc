@@ -18,6 +18,8 @@
 #include "mldb/types/vector_description.h"
 #include "mldb/base/scope.h"
 #include "mldb/utils/log.h"
+#include "mldb/utils/top_n.h"
+#include "mldb/sql/query_explain.h"
 
 using namespace std;
 
@@ -255,6 +257,8 @@ generateMore(SqlRowScope & rowScope)
     // Ask for some more
     current.clear();
 
+    arena.newBatch();
+    RowArenaScope arenaScope(&arena);
     current = generator(1000, rowScope, params);
     currentDone = 0;
     if (current.empty()) {
@@ -344,7 +348,7 @@ Bound(const GenerateRowsElement * parent,
 
 std::shared_ptr<ElementExecutor>
 GenerateRowsElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<GenerateRowsExecutor>();
     result->source = source_->start(getParam);
@@ -359,6 +363,13 @@ start(const BoundParameters & getParam) const
                                 nullptr /*onProgress*/);
     result->params = getParam;
     ExcAssert(result->params);
+
+    if (auto node = QueryExplainScope::current()) {
+        node->details["as"] = parent->as;
+        node->details["where"] = parent->where->surface;
+        node->details["rowGenerator"] = result->generator.explain;
+    }
+
     return result;
 }
 
@@ -525,7 +536,7 @@ Bound(const SubSelectElement * parent,
 
 std::shared_ptr<ElementExecutor>
 SubSelectElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<SubSelectExecutor>(boundSelect, getParam);
     return result;
@@ -1627,7 +1638,7 @@ createOutputScope()
         
 std::shared_ptr<ElementExecutor>
 JoinElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     size_t leftAdded = left_->outputScope()->defaultScope()->outputAdded().size();
     size_t rightAdded = right_->outputScope()->defaultScope()->outputAdded().size();
@@ -1733,7 +1744,7 @@ Bound(std::shared_ptr<SqlBindingScope> outer)
 
 std::shared_ptr<ElementExecutor>
 RootElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     return std::make_shared<Executor>();
 }
@@ -1990,7 +2001,7 @@ Bound(std::shared_ptr<BoundPipelineElement> source,
 
 std::shared_ptr<ElementExecutor>
 FilterWhereElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<Executor>();
     result->parent_ = this;
@@ -2044,6 +2055,12 @@ bind() const
 /* SELECT ELEMENT EXECUTOR                                                   */
 /*****************************************************************************/
 
+SelectElement::Executor::
+Executor()
+    : parent(nullptr), rowsInBatch(0)
+{
+}
+
 std::shared_ptr<PipelineResults>
 SelectElement::Executor::
 take()
@@ -2055,7 +2072,13 @@ take()
         if (!input)
             return input;
 
+        if (++rowsInBatch == ROWS_PER_BATCH) {
+            arena.newBatch();
+            rowsInBatch = 0;
+        }
+
         // Run the select expression in this input's context
+        RowArenaScope arenaScope(&arena);
         ExpressionValue selected = parent->select_(*input, GET_ALL);
 
         input->values.emplace_back(std::move(selected));
@@ -2088,7 +2111,7 @@ Bound(std::shared_ptr<BoundPipelineElement> source,
 
 std::shared_ptr<ElementExecutor>
 SelectElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<Executor>();
     result->parent = this;
@@ -2117,8 +2140,9 @@ outputScope() const
 
 OrderByElement::
 OrderByElement(std::shared_ptr<PipelineElement> source,
-               OrderByExpression orderBy)
-    : source(source), orderBy(orderBy)
+               OrderByExpression orderBy,
+               ssize_t maxRows)
+    : source(source), orderBy(orderBy), maxRows(maxRows)
 {
 }
 
@@ -2126,7 +2150,7 @@ std::shared_ptr<BoundPipelineElement>
 OrderByElement::
 bind() const
 {
-    return std::make_shared<Bound>(source->bind(), orderBy);
+    return std::make_shared<Bound>(source->bind(), orderBy, maxRows);
 }
 
 
@@ -2150,15 +2174,6 @@ take()
     // from the input, sort it, and get it ready to serve up as results
     // of the query.
     if (numDone == -1) {
-        // Get and sort the input
-
-        while (true) {
-            std::shared_ptr<PipelineResults> input = source->take();
-            if (!input)
-                break;
-            sorted.emplace_back(std::move(input));
-        }
-
         // We assume that the fields to sort on are at the end of the
         // list of fields.
         int offset
@@ -2173,7 +2188,46 @@ take()
                                              offset);
             };
 
-        std::sort(sorted.begin(), sorted.end(), compare);
+        if (parent->maxRows_ != -1) {
+            // Only the first maxRows rows are needed, so keep just those
+            // as we go.  Ties keep the order of the input.
+            typedef std::pair<std::shared_ptr<PipelineResults>, size_t>
+                NumberedResults;
+            auto compareNumbered = [&] (const NumberedResults & p1,
+                                        const NumberedResults & p2)
+                -> bool
+                {
+                    if (compare(p1.first, p2.first))
+                        return true;
+                    if (compare(p2.first, p1.first))
+                        return false;
+                    return p1.second < p2.second;
+                };
+
+            TopN<NumberedResults, decltype(compareNumbered)>
+                top(parent->maxRows_, compareNumbered);
+
+            for (size_t n = 0;  ;  ++n) {
+                std::shared_ptr<PipelineResults> input = source->take();
+                if (!input)
+                    break;
+                top.add({ std::move(input), n });
+            }
+
+            for (auto & r: top.extractSorted())
+                sorted.emplace_back(std::move(r.first));
+        }
+        else {
+            // Get and sort the input
+            while (true) {
+                std::shared_ptr<PipelineResults> input = source->take();
+                if (!input)
+                    break;
+                sorted.emplace_back(std::move(input));
+            }
+
+            std::sort(sorted.begin(), sorted.end(), compare);
+        }
                 
         numDone = 0;
     }
@@ -2203,17 +2257,19 @@ restart()
 
 OrderByElement::Bound::
 Bound(std::shared_ptr<BoundPipelineElement> source,
-      const OrderByExpression & orderBy)
+      const OrderByExpression & orderBy,
+      ssize_t maxRows)
     : source_(std::move(source)),
       scope_(source_->outputScope()),
-      orderBy_(orderBy.bindAll(*scope_))
+      orderBy_(orderBy.bindAll(*scope_)),
+      maxRows_(maxRows)
 {
     ExcAssert(scope_->inLexicalScope());
 }
 
 std::shared_ptr<ElementExecutor>
 OrderByElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     return std::make_shared<Executor>(this,
                                       source_->start(getParam));
@@ -2487,7 +2543,7 @@ Bound(std::shared_ptr<BoundPipelineElement> source,
 
 std::shared_ptr<ElementExecutor>
 PartitionElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     return std::make_shared<Executor>
         (this, source_->start(getParam),
@@ -2573,7 +2629,7 @@ Bound(std::shared_ptr<BoundPipelineElement> source,
         
 std::shared_ptr<ElementExecutor>
 ParamsElement::Bound::
-start(const BoundParameters & getParam) const
+doStart(const BoundParameters & getParam) const
 {
     return std::make_shared<Executor>(source_->start(getParam),
                                       getParam);
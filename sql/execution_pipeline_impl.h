@@ -9,6 +9,7 @@
 
 #include "execution_pipeline.h"
 #include "join_utils.h"
+#include "row_arena.h"
 #include "mldb/utils/log_fwd.h"
 #include <list>
 
@@ -75,6 +76,9 @@ struct GenerateRowsExecutor: public ElementExecutor {
     size_t currentDone;
     bool finished;
 
+    /// The rows of each batch that's generated are allocated from here
+    RowArena arena;
+
     bool generateMore(SqlRowScope & scope);
 
     virtual std::shared_ptr<PipelineResults> take();
@@ -116,7 +120,7 @@ struct GenerateRowsElement: public PipelineElement {
               std::shared_ptr<BoundPipelineElement> source);
 
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -214,7 +218,7 @@ struct SubSelectElement: public PipelineElement {
               std::shared_ptr<BoundPipelineElement> source);
 
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -452,7 +456,7 @@ struct JoinElement: public PipelineElement {
         createOutputScope();
         
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -493,7 +497,7 @@ struct RootElement: public PipelineElement {
         std::shared_ptr<PipelineExpressionScope> scope_;
 
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -584,7 +588,7 @@ struct FilterWhereElement: public PipelineElement {
         BoundSqlExpression where_;
 
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -618,9 +622,18 @@ struct SelectElement: public PipelineElement {
     struct Bound;
 
     struct Executor: public ElementExecutor {
+        Executor();
+
         const Bound * parent;
         std::shared_ptr<ElementExecutor> source;
 
+        /// The selected rows are allocated from here, in batches of
+        /// ROWS_PER_BATCH rows
+        RowArena arena;
+        size_t rowsInBatch;
+
+        static constexpr size_t ROWS_PER_BATCH = 1000;
+
         virtual std::shared_ptr<PipelineResults> take();
 
         virtual void restart();
@@ -636,7 +649,7 @@ struct SelectElement: public PipelineElement {
         std::shared_ptr<PipelineExpressionScope> outputScope_;
         
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -659,11 +672,15 @@ struct SelectElement: public PipelineElement {
 
 struct OrderByElement: public PipelineElement {
     OrderByElement(std::shared_ptr<PipelineElement> source,
-                   OrderByExpression orderBy);
+                   OrderByExpression orderBy,
+                   ssize_t maxRows = -1);
 
     std::shared_ptr<PipelineElement> source;
     OrderByExpression orderBy;
 
+    /// If not -1, only this many of the first rows in order are output
+    ssize_t maxRows;
+
     struct Bound;
 
     struct Executor: public ElementExecutor {
@@ -685,14 +702,16 @@ struct OrderByElement: public PipelineElement {
     struct Bound: public BoundPipelineElement {
 
         Bound(std::shared_ptr<BoundPipelineElement> source,
-              const OrderByExpression & orderBy);
+              const OrderByExpression & orderBy,
+              ssize_t maxRows);
 
         std::shared_ptr<BoundPipelineElement> source_;
         std::shared_ptr<PipelineExpressionScope> scope_;
         BoundOrderByExpression orderBy_;
+        ssize_t maxRows_;
         
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -792,7 +811,7 @@ struct PartitionElement: public PipelineElement {
         int numValues_;
         
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
         
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
@@ -843,7 +862,7 @@ struct ParamsElement: public PipelineElement {
         std::shared_ptr<PipelineExpressionScope> outputScope_;
         
         std::shared_ptr<ElementExecutor>
-        start(const BoundParameters & getParam) const;
+        doStart(const BoundParameters & getParam) const;
 
         virtual std::shared_ptr<BoundPipelineElement>
         boundSource() const;
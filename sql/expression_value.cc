@@ -24,6 +24,7 @@
 #include "mldb/utils/lightweight_hash.h"
 #include "mldb/utils/compact_vector.h"
 #include "mldb/base/optimized_path.h"
+#include "mldb/sql/row_arena.h"
 #include "mldb/ext/highwayhash.h"
 
 using namespace std;
@@ -2166,6 +2167,16 @@ getEmbeddingType() const
     throw AnnotatedException(500, "Querying embedding type on non-embedding value");
 }
 
+std::shared_ptr<const void>
+ExpressionValue::
+getEmbeddingData() const
+{
+    if (type_ == Type::EMBEDDING)
+        return embedding_->data_;
+    
+    throw AnnotatedException(500, "Querying embedding data on non-embedding value");
+}
+
 ExpressionValue
 ExpressionValue::
 superpose(std::vector<ExpressionValue> vals)
@@ -4241,6 +4252,8 @@ initUInt(uint64_t intValue, Date ts)
     setAtom(intValue, ts);
 }
 
+static OptimizedPath useRowArena("mldb.sql.useRowArena");
+
 void
 ExpressionValue::
 initStructured(Structured value) noexcept
@@ -4320,7 +4333,15 @@ initStructured(Structured value, bool needsSorting, bool hasDuplicates) noexcept
         }
     }
 
-    initStructured(std::make_shared<Structured>(std::move(value)));
+    // Within a pipeline, rows are allocated from the arena of their batch
+    RowArena * arena = RowArenaScope::current();
+    if (arena && useRowArena.take()) {
+        initStructured(std::allocate_shared<Structured>
+                       (RowArenaAllocator<Structured>(arena), std::move(value)));
+    }
+    else {
+        initStructured(std::make_shared<Structured>(std::move(value)));
+    }
 }
 
 void
@@ -5222,5 +5243,57 @@ NamedRowValue::flatten() const
 }
 
 
+/*****************************************************************************/
+/* MEMORY USAGE                                                              */
+/*****************************************************************************/
+
+size_t approxMemusage(const ExpressionValue & val)
+{
+    size_t result = sizeof(ExpressionValue);
+    if (val.isAtom()) {
+        return result + val.getAtom().memusage() - sizeof(CellValue);
+    }
+    if (val.isEmbedding()) {
+        size_t n = 1;
+        for (auto & d: val.getEmbeddingShape())
+            n *= d;
+        return result + n * sizeof(double);
+    }
+    if (val.isRow()) {
+        auto onColumn = [&] (const PathElement & name,
+                             const ExpressionValue & col)
+            {
+                result += name.memusage() + approxMemusage(col);
+                return true;
+            };
+        val.forEachColumn(onColumn);
+        return result;
+    }
+    auto onValue = [&] (const ExpressionValue & v)
+        {
+            result += approxMemusage(v);
+            return true;
+        };
+    val.forEachSuperposedValue(onValue);
+    return result;
+}
+
+size_t approxMemusage(const std::vector<ExpressionValue> & vals)
+{
+    size_t result = sizeof(vals);
+    for (auto & v: vals)
+        result += approxMemusage(v);
+    return result;
+}
+
+size_t approxMemusage(const NamedRowValue & row)
+{
+    size_t result = sizeof(row) + row.rowName.memusage();
+    for (auto & c: row.columns) {
+        result += std::get<0>(c).memusage() + approxMemusage(std::get<1>(c));
+    }
+    return result;
+}
+
 } // namespace MLDB
 
@@ -1086,6 +1086,14 @@ struct ExpressionValue {
     */
     StorageType getEmbeddingType() const;
 
+    /** Return the buffer holding the elements of the embedding, which are
+        of the type returned by getEmbeddingType() and in the same order
+        as for convertEmbedding().  This allows them to be read without
+        being copied.
+        Will throw an error if not an embedding.
+    */
+    std::shared_ptr<const void> getEmbeddingData() const;
+
     /** Iterate over the child expression, with an ExpressionValue at each
         level.  Note that if isRow() is false, than this function will
         NOT call the callback; it's only called for row-valued values.
@@ -1934,6 +1942,14 @@ struct NamedRowValue {
 
 DECLARE_STRUCTURE_DESCRIPTION(NamedRowValue);
 
+/** Return an estimate of the memory used by a value, including the memory
+    of the value itself.  This is much cheaper than serializing the value,
+    and is used to account for the memory held by queries.
+*/
+size_t approxMemusage(const ExpressionValue & val);
+size_t approxMemusage(const std::vector<ExpressionValue> & vals);
+size_t approxMemusage(const NamedRowValue & row);
+
 
 
 /*****************************************************************************/
@@ -2,6 +2,7 @@
 #include "mldb/types/enum_description.h"
 #include "mldb/types/annotated_exception.h"
 #include "mldb/utils/distribution.h"
+#include <cstring>
 
 
 namespace MLDB {
@@ -477,6 +478,21 @@ convertEmbeddingImpl(void * to,
                      StorageType toType,
                      StorageType fromType)
 {
+    // Numbers of the same type are a straight copy
+    if (toType == fromType) {
+        switch (toType) {
+        case ST_FLOAT32: case ST_FLOAT64:
+        case ST_INT8:    case ST_UINT8:
+        case ST_INT16:   case ST_UINT16:
+        case ST_INT32:   case ST_UINT32:
+        case ST_INT64:   case ST_UINT64:
+            std::memcpy(to, from, len * getCellSizeInBytes(toType));
+            return;
+        default:
+            break;
+        }
+    }
+
     switch (toType) {
     case ST_FLOAT32:
         getNumbers(from,
@@ -10,6 +10,7 @@
 #include "mldb/types/meta_value_description.h"
 #include "mldb/types/annotated_exception.h"
 #include <unordered_map>
+#include <type_traits>
 
 namespace MLDB {
 
@@ -35,6 +36,74 @@ struct FieldInfo {
     PathElement fieldName;
 };
 
+/** Convert through JSON, which works for any value with a description. */
+std::tuple<std::shared_ptr<ExpressionValueInfo>, FromInput, ToOutput>
+jsonConverters(std::shared_ptr<const ValueDescription> desc)
+{
+    auto info = std::make_shared<AnyValueInfo>();
+
+    FromInput fromInput = [desc] (void * obj, const ExpressionValue & input)
+        {
+            Json::Value val = input.extractJson();
+            StructuredJsonParsingContext context(val);
+            desc->parseJson(obj, context);
+        };
+
+    ToOutput toOutput = [desc] (const void * obj) -> ExpressionValue
+        {
+            Json::Value val;
+            StructuredJsonPrintingContext context(val);
+            desc->printJson(obj, context);
+            return ExpressionValue(val, Date::notADate());
+        };
+
+    return std::make_tuple(info, fromInput, toOutput);
+}
+
+/** Convert a number directly to and from a CellValue, which gives the
+    same result as going through JSON without the cost of building a
+    Json::Value for each.  Inputs that aren't plain numbers of the right
+    kind, whose conversion through JSON has its own rules and errors,
+    still go through JSON.
+*/
+template<typename T>
+std::tuple<std::shared_ptr<ExpressionValueInfo>, FromInput, ToOutput>
+numberConverters(std::shared_ptr<const ValueDescription> desc, bool isFloat)
+{
+    FromInput viaJson = std::get<1>(jsonConverters(desc));
+
+    FromInput fromInput
+        = [viaJson, isFloat] (void * obj, const ExpressionValue & input)
+        {
+            if (input.isAtom()) {
+                const CellValue & atom = input.getAtom();
+                if (isFloat ? atom.isNumber()
+                    : std::is_signed<T>::value ? atom.isInt64()
+                    : atom.isUInt64()) {
+                    T & val = *static_cast<T *>(obj);
+                    if (isFloat)
+                        val = atom.toDouble();
+                    else if (std::is_signed<T>::value)
+                        val = atom.toInt();
+                    else val = atom.toUInt();
+                    // If it didn't fit, let JSON deal with it
+                    if (isFloat || atom == CellValue(val))
+                        return;
+                }
+            }
+            viaJson(obj, input);
+        };
+
+    ToOutput toOutput = [] (const void * obj) -> ExpressionValue
+        {
+            return ExpressionValue(CellValue(*static_cast<const T *>(obj)),
+                                   Date::notADate());
+        };
+
+    return std::make_tuple(std::make_shared<AnyValueInfo>(),
+                           fromInput, toOutput);
+}
+
 } // file scope
 
 std::tuple<std::shared_ptr<ExpressionValueInfo>,
@@ -81,6 +150,15 @@ toValueInfo(std::shared_ptr<const ValueDescription> desc)
         // object is expected.
         auto fromInput = [=] (void * obj, const ExpressionValue & input)
             {
+                // Fields that have been set.  A field is normally seen
+                // once, in which case the value passed in is the value of
+                // the field; if it's seen more than once, we look up its
+                // latest value instead.
+                uint64_t seenStorage = 0;
+                std::vector<bool> seenMany;
+                if (fields.size() > 64)
+                    seenMany.resize(fields.size());
+
                 auto onColumn = [&] (const PathElement & columnName,
                                      const ExpressionValue & val)
                 {
@@ -93,9 +171,27 @@ toValueInfo(std::shared_ptr<const ValueDescription> desc)
 
                     const FieldInfo & f = fields[it->second];
 
+                    bool seen;
+                    if (seenMany.empty()) {
+                        uint64_t bit = 1ULL << it->second;
+                        seen = seenStorage & bit;
+                        seenStorage |= bit;
+                    }
+                    else {
+                        seen = seenMany[it->second];
+                        seenMany[it->second] = true;
+                    }
+
                     // Run the conversion recursively
-                    f.fromInput(f.desc.getFieldPtr(obj),
-                                input.getColumn(f.fieldName));
+                    if (seen) {
+                        f.fromInput(f.desc.getFieldPtr(obj),
+                                    input.getColumn(f.fieldName));
+                    }
+                    else {
+                        ExpressionValue storage;
+                        f.fromInput(f.desc.getFieldPtr(obj),
+                                    val.getFiltered(GET_LATEST, storage));
+                    }
 
                     return true;
                 };
@@ -227,7 +323,34 @@ toValueInfo(std::shared_ptr<const ValueDescription> desc)
     }
 
     case ValueKind::INTEGER:
+        if (*desc->type == typeid(int)) {
+            return numberConverters<int>(desc, false /* isFloat */);
+        }
+        else if (*desc->type == typeid(unsigned)) {
+            return numberConverters<unsigned>(desc, false /* isFloat */);
+        }
+        else if (*desc->type == typeid(long)) {
+            return numberConverters<long>(desc, false /* isFloat */);
+        }
+        else if (*desc->type == typeid(unsigned long)) {
+            return numberConverters<unsigned long>(desc, false /* isFloat */);
+        }
+        else if (*desc->type == typeid(long long)) {
+            return numberConverters<long long>(desc, false /* isFloat */);
+        }
+        else if (*desc->type == typeid(unsigned long long)) {
+            return numberConverters<unsigned long long>
+                (desc, false /* isFloat */);
+        }
+        // fall through
     case ValueKind::FLOAT:
+        if (*desc->type == typeid(double)) {
+            return numberConverters<double>(desc, true /* isFloat */);
+        }
+        else if (*desc->type == typeid(float)) {
+            return numberConverters<float>(desc, true /* isFloat */);
+        }
+        // fall through
     case ValueKind::BOOLEAN:
     case ValueKind::ENUM:
     case ValueKind::OPTIONAL:
@@ -238,23 +361,7 @@ toValueInfo(std::shared_ptr<const ValueDescription> desc)
     case ValueKind::MAP:
     case ValueKind::ANY: {
         // Go through JSON
-        auto info = std::make_shared<AnyValueInfo>();
-
-        FromInput fromInput = [desc] (void * obj, const ExpressionValue & input)
-            {
-                Json::Value val = input.extractJson();
-                StructuredJsonParsingContext context(val);
-                desc->parseJson(obj, context);
-            };
-            
-        ToOutput toOutput = [desc] (const void * obj) -> ExpressionValue
-            {
-                Json::Value val;
-                StructuredJsonPrintingContext context(val);
-                desc->printJson(obj, context);
-                return ExpressionValue(val, Date::notADate());
-            };
-        return std::make_tuple(info, fromInput, toOutput);
+        return jsonConverters(desc);
     }
     }
 
@@ -0,0 +1,285 @@
+/** image_decoding.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Decoding of compressed images into arrays of pixels.
+*/
+
+#include "mldb/sql/image_decoding.h"
+#include "mldb/types/annotated_exception.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <csetjmp>
+#include <cstdio>
+
+extern "C" {
+#include "mldb/ext/jpeg/jpeglib.h"
+}
+
+
+namespace MLDB {
+
+namespace {
+
+/** A libjpeg decompressor along with the buffers used to decode and
+    resize an image, all of which are kept from one image to the next.
+*/
+struct JpegDecoder {
+    JpegDecoder()
+    {
+        cinfo.err = jpeg_std_error(&err.pub);
+        err.pub.error_exit = &onError;
+        err.pub.output_message = &onMessage;
+        jpeg_create_decompress(&cinfo);
+    }
+
+    ~JpegDecoder()
+    {
+        jpeg_destroy_decompress(&cinfo);
+    }
+
+    JpegDecoder(const JpegDecoder &) = delete;
+    void operator = (const JpegDecoder &) = delete;
+
+    /// libjpeg reports errors by calling error_exit, which mustn't return,
+    /// so we jump back to where the decoding started
+    struct ErrorManager {
+        jpeg_error_mgr pub;
+        jmp_buf jump;
+        char message[JMSG_LENGTH_MAX];
+    };
+
+    static void onError(j_common_ptr cinfo)
+    {
+        ErrorManager * err = reinterpret_cast<ErrorManager *>(cinfo->err);
+        (*cinfo->err->format_message)(cinfo, err->message);
+        longjmp(err->jump, 1);
+    }
+
+    static void onMessage(j_common_ptr cinfo)
+    {
+        // Warnings aren't printed
+    }
+
+    jpeg_decompress_struct cinfo;
+    ErrorManager err;
+
+    std::vector<uint8_t> decoded;     ///< Image as decoded
+    std::vector<int> x0, x1;          ///< Columns to interpolate between
+    std::vector<float> xWeight;       ///< Weight of x1 for each column
+};
+
+/** Decoders that aren't being used.  At most one per hardware thread is
+    kept.
+*/
+struct JpegDecoderPool {
+    std::unique_ptr<JpegDecoder> acquire()
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            if (!decoders.empty()) {
+                auto result = std::move(decoders.back());
+                decoders.pop_back();
+                return result;
+            }
+        }
+        return std::unique_ptr<JpegDecoder>(new JpegDecoder());
+    }
+
+    void release(std::unique_ptr<JpegDecoder> decoder)
+    {
+        static const size_t maxDecoders
+            = std::max<size_t>(1, std::thread::hardware_concurrency());
+        std::unique_lock<std::mutex> guard(mutex);
+        if (decoders.size() < maxDecoders)
+            decoders.emplace_back(std::move(decoder));
+    }
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<JpegDecoder> > decoders;
+};
+
+JpegDecoderPool & decoderPool()
+{
+    static JpegDecoderPool result;
+    return result;
+}
+
+/** A decoder from the pool, which goes back into it when done. */
+struct PooledJpegDecoder {
+    PooledJpegDecoder()
+        : decoder(decoderPool().acquire())
+    {
+    }
+
+    ~PooledJpegDecoder()
+    {
+        decoderPool().release(std::move(decoder));
+    }
+
+    JpegDecoder * operator -> () const { return decoder.get(); }
+
+    std::unique_ptr<JpegDecoder> decoder;
+};
+
+/** Read the header of the image.  Returns false with the error in the
+    decoder's message on failure.  There must be no objects with
+    destructors in here, as an error jumps straight out of libjpeg.
+*/
+bool readHeader(JpegDecoder & decoder, const unsigned char * data, size_t len)
+{
+    jpeg_decompress_struct & cinfo = decoder.cinfo;
+
+    if (setjmp(decoder.err.jump)) {
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_mem_src(&cinfo, const_cast<unsigned char *>(data), len);
+    jpeg_read_header(&cinfo, TRUE);
+    return true;
+}
+
+/** Decode the image into the decoder's buffer, at the smallest scale at
+    which it is at least minWidth by minHeight.  The header must already
+    have been read.  Same rules as readHeader().
+*/
+bool decodeScaled(JpegDecoder & decoder, int minWidth, int minHeight,
+                  int channels)
+{
+    jpeg_decompress_struct & cinfo = decoder.cinfo;
+
+    if (setjmp(decoder.err.jump)) {
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+
+    cinfo.out_color_space = channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+
+    cinfo.scale_denom = 8;
+    cinfo.scale_num = 8;
+    for (unsigned num = 1;  num < 8;  ++num) {
+        size_t width = (cinfo.image_width * num + 7) / 8;
+        size_t height = (cinfo.image_height * num + 7) / 8;
+        if (width >= minWidth && height >= minHeight) {
+            cinfo.scale_num = num;
+            break;
+        }
+    }
+
+    jpeg_start_decompress(&cinfo);
+
+    size_t stride = cinfo.output_width * channels;
+    decoder.decoded.resize(stride * cinfo.output_height);
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = decoder.decoded.data() + cinfo.output_scanline * stride;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    return true;
+}
+
+/** Resize the decoded image into out with bilinear interpolation.  The
+    inner loop is over contiguous bytes with precomputed weights, which the
+    compiler vectorizes.
+*/
+void resize(JpegDecoder & decoder, int inWidth, int inHeight,
+            ImageSize size, int channels, uint8_t * out)
+{
+    const uint8_t * in = decoder.decoded.data();
+    size_t inStride = inWidth * channels;
+    size_t outStride = size.width * channels;
+
+    if (inWidth == size.width && inHeight == size.height) {
+        std::copy(in, in + inStride * inHeight, out);
+        return;
+    }
+
+    // Position in the input of the center of each output pixel
+    auto source = [] (int i, int inSize, int outSize, int & i0, int & i1,
+                      float & weight)
+        {
+            float pos = (i + 0.5f) * inSize / outSize - 0.5f;
+            pos = std::max(0.0f, std::min<float>(pos, inSize - 1));
+            i0 = (int)pos;
+            i1 = std::min(i0 + 1, inSize - 1);
+            weight = pos - i0;
+        };
+
+    // Horizontal weights, per output byte
+    decoder.x0.resize(outStride);
+    decoder.x1.resize(outStride);
+    decoder.xWeight.resize(outStride);
+    for (int x = 0;  x < size.width;  ++x) {
+        int i0, i1;
+        float weight;
+        source(x, inWidth, size.width, i0, i1, weight);
+        for (int c = 0;  c < channels;  ++c) {
+            decoder.x0[x * channels + c] = i0 * channels + c;
+            decoder.x1[x * channels + c] = i1 * channels + c;
+            decoder.xWeight[x * channels + c] = weight;
+        }
+    }
+
+    const int * x0 = decoder.x0.data();
+    const int * x1 = decoder.x1.data();
+    const float * xWeight = decoder.xWeight.data();
+
+    for (int y = 0;  y < size.height;  ++y) {
+        int y0, y1;
+        float yWeight;
+        source(y, inHeight, size.height, y0, y1, yWeight);
+        const uint8_t * row0 = in + y0 * inStride;
+        const uint8_t * row1 = in + y1 * inStride;
+        uint8_t * outRow = out + y * outStride;
+
+        for (size_t i = 0;  i < outStride;  ++i) {
+            float top = row0[x0[i]] + (row0[x1[i]] - row0[x0[i]]) * xWeight[i];
+            float bottom = row1[x0[i]] + (row1[x1[i]] - row1[x0[i]]) * xWeight[i];
+            outRow[i] = (uint8_t)(top + (bottom - top) * yWeight + 0.5f);
+        }
+    }
+}
+
+} // file scope
+
+ImageSize getJpegSize(const unsigned char * data, size_t len)
+{
+    PooledJpegDecoder decoder;
+    if (!readHeader(*decoder.decoder, data, len)) {
+        throw AnnotatedException(400, "Couldn't read JPEG image: "
+                                 + std::string(decoder->err.message));
+    }
+
+    ImageSize result;
+    result.width = decoder->cinfo.image_width;
+    result.height = decoder->cinfo.image_height;
+    jpeg_abort_decompress(&decoder->cinfo);
+    return result;
+}
+
+void decodeJpeg(const unsigned char * data, size_t len,
+                ImageSize size, int channels, uint8_t * out)
+{
+    if (channels != 1 && channels != 3)
+        throw AnnotatedException(400, "JPEG images can only be decoded to 1 "
+                                 "or 3 channels");
+    if (size.width <= 0 || size.height <= 0)
+        throw AnnotatedException(400, "Decoded image size must be positive");
+
+    PooledJpegDecoder decoder;
+    if (!readHeader(*decoder.decoder, data, len)
+        || !decodeScaled(*decoder.decoder, size.width, size.height, channels)) {
+        throw AnnotatedException(400, "Couldn't decode JPEG image: "
+                                 + std::string(decoder->err.message));
+    }
+
+    resize(*decoder.decoder, decoder->cinfo.output_width,
+           decoder->cinfo.output_height, size, channels, out);
+}
+
+} // namespace MLDB
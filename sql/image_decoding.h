@@ -0,0 +1,48 @@
+/** image_decoding.h                                                -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Decoding of compressed images into arrays of pixels.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* JPEG DECODING                                                             */
+/*****************************************************************************/
+
+/** Size of a decoded image. */
+struct ImageSize {
+    int width = 0;
+    int height = 0;
+};
+
+/** Return the size of the JPEG image in the buffer, reading only its
+    header.  Throws if it's not a valid JPEG image.
+*/
+ImageSize getJpegSize(const unsigned char * data, size_t len);
+
+/** Decode the JPEG image in the buffer into out, which holds
+    size.height * size.width * channels bytes with the channels of each
+    pixel together and the pixels in rows from the top.  Channels is 1 for
+    grayscale or 3 for RGB.  The image is resized to the given size, which
+    is done by the decoder itself for the most part: it decodes at the
+    smallest fraction of the full size (in eighths) that is at least as big
+    as required, which skips most of the work for large images, and the
+    rest is done with bilinear interpolation.
+
+    Decoders are taken from a pool and returned once done, so that their
+    state and buffers are reused from one image to the next; this function
+    may be called from many threads at once.  Throws if the image can't be
+    decoded.
+*/
+void decodeJpeg(const unsigned char * data, size_t len,
+                ImageSize size, int channels, uint8_t * out);
+
+} // namespace MLDB
@@ -0,0 +1,357 @@
+/** json_extract.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Extraction of a single field of a JSON document without parsing the
+    rest of it.
+*/
+
+#include "json_extract.h"
+#include "mldb/types/json_parsing.h"
+
+
+namespace MLDB {
+
+namespace {
+
+/** Scanner that checks the structure of a JSON document and skips over
+    the values that aren't wanted, without building anything.  It only
+    accepts strict JSON; anything else is left to the full parser.
+*/
+struct JsonScanner {
+    JsonScanner(const char * start, const char * end)
+        : p(start), e(end)
+    {
+    }
+
+    const char * p;
+    const char * e;
+
+    /// Nesting deeper than this is left to the full parser
+    static constexpr int MAX_DEPTH = 256;
+
+    void skipWhitespace()
+    {
+        while (p < e && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+            ++p;
+    }
+
+    bool match(char c)
+    {
+        skipWhitespace();
+        if (p == e || *p != c)
+            return false;
+        ++p;
+        return true;
+    }
+
+    /// Scan a string, giving the characters between the quotes and
+    /// whether there were any escapes in it
+    bool scanString(const char * & start, size_t & len, bool & escaped)
+    {
+        skipWhitespace();
+        if (p == e || *p != '"')
+            return false;
+        start = ++p;
+        escaped = false;
+
+        while (p < e) {
+            unsigned char c = *p;
+            if (c == '"') {
+                len = p - start;
+                ++p;
+                return true;
+            }
+            if (c < 0x20)
+                return false;
+            ++p;
+            if (c != '\\')
+                continue;
+
+            escaped = true;
+            if (p == e)
+                return false;
+            switch (*p++) {
+            case '"': case '\\': case '/': case 'b':
+            case 'f': case 'n': case 'r': case 't':
+                break;
+            case 'u':
+                for (int i = 0;  i < 4;  ++i, ++p) {
+                    if (p == e || !isxdigit((unsigned char)*p))
+                        return false;
+                }
+                break;
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    /** Decode the escapes in the characters of a string scanned by
+        scanString() into out, as UTF-8.  Returns false for a lone
+        surrogate, which is left to the full parser.
+    */
+    static bool decodeString(const char * start, size_t len,
+                             std::string & out)
+    {
+        out.clear();
+        const char * end = start + len;
+        auto readHex = [&] (unsigned & code) -> bool
+            {
+                if (end - start < 4)
+                    return false;
+                code = 0;
+                for (int i = 0;  i < 4;  ++i) {
+                    char c = *start++;
+                    code = code * 16
+                        + (isdigit((unsigned char)c)
+                           ? c - '0' : (tolower((unsigned char)c) - 'a' + 10));
+                }
+                return true;
+            };
+
+        while (start < end) {
+            char c = *start++;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            switch (*start++) {
+            case '"':  out += '"';   break;
+            case '\\': out += '\\';  break;
+            case '/':  out += '/';   break;
+            case 'b':  out += '\b';  break;
+            case 'f':  out += '\f';  break;
+            case 'n':  out += '\n';  break;
+            case 'r':  out += '\r';  break;
+            case 't':  out += '\t';  break;
+            case 'u': {
+                unsigned code;
+                if (!readHex(code))
+                    return false;
+                if (code >= 0xdc00 && code < 0xe000)
+                    return false;
+                if (code >= 0xd800 && code < 0xdc00) {
+                    unsigned low;
+                    if (end - start < 6 || start[0] != '\\'
+                        || start[1] != 'u')
+                        return false;
+                    start += 2;
+                    if (!readHex(low) || low < 0xdc00 || low >= 0xe000)
+                        return false;
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                }
+                if (code < 0x80) {
+                    out += (char)code;
+                }
+                else if (code < 0x800) {
+                    out += (char)(0xc0 | (code >> 6));
+                    out += (char)(0x80 | (code & 0x3f));
+                }
+                else if (code < 0x10000) {
+                    out += (char)(0xe0 | (code >> 12));
+                    out += (char)(0x80 | ((code >> 6) & 0x3f));
+                    out += (char)(0x80 | (code & 0x3f));
+                }
+                else {
+                    out += (char)(0xf0 | (code >> 18));
+                    out += (char)(0x80 | ((code >> 12) & 0x3f));
+                    out += (char)(0x80 | ((code >> 6) & 0x3f));
+                    out += (char)(0x80 | (code & 0x3f));
+                }
+                break;
+            }
+            default:
+                return false;  // already checked by scanString()
+            }
+        }
+        return true;
+    }
+
+    bool scanDigits()
+    {
+        const char * start = p;
+        while (p < e && *p >= '0' && *p <= '9')
+            ++p;
+        return p != start;
+    }
+
+    bool scanNumber()
+    {
+        if (p < e && *p == '-')
+            ++p;
+        if (p < e && *p == '0')
+            ++p;
+        else if (!scanDigits())
+            return false;
+        if (p < e && *p == '.') {
+            ++p;
+            if (!scanDigits())
+                return false;
+        }
+        if (p < e && (*p == 'e' || *p == 'E')) {
+            ++p;
+            if (p < e && (*p == '+' || *p == '-'))
+                ++p;
+            if (!scanDigits())
+                return false;
+        }
+        return true;
+    }
+
+    bool scanLiteral(const char * literal, size_t len)
+    {
+        if (e - p < (ssize_t)len || strncmp(p, literal, len) != 0)
+            return false;
+        p += len;
+        return true;
+    }
+
+    /// Skip over an element, checking that it's well formed
+    bool skipValue(int depth)
+    {
+        if (depth > MAX_DEPTH)
+            return false;
+
+        skipWhitespace();
+        if (p == e)
+            return false;
+
+        const char * start;
+        size_t len;
+        bool escaped;
+
+        switch (*p) {
+        case '{':
+            ++p;
+            if (match('}'))
+                return true;
+            do {
+                if (!scanString(start, len, escaped) || !match(':')
+                    || !skipValue(depth + 1))
+                    return false;
+            } while (match(','));
+            return match('}');
+        case '[':
+            ++p;
+            if (match(']'))
+                return true;
+            do {
+                if (!skipValue(depth + 1))
+                    return false;
+            } while (match(','));
+            return match(']');
+        case '"':
+            return scanString(start, len, escaped);
+        case 't':
+            return scanLiteral("true", 4);
+        case 'f':
+            return scanLiteral("false", 5);
+        case 'n':
+            return scanLiteral("null", 4);
+        default:
+            return scanNumber();
+        }
+    }
+
+    /** Scan the object at the current position, of which we want the
+        member named column[index].  The output holds only that member,
+        which itself only holds the rest of the path if it's an object.
+    */
+    bool extractObject(const ColumnPath & column, size_t index,
+                       Date timestamp, ExpressionValue & output)
+    {
+        if (index > MAX_DEPTH || !match('{'))
+            return false;
+
+        StructValue result;
+        std::string decodedKey;
+
+        if (!match('}')) {
+            do {
+                const char * key;
+                size_t keyLen;
+                bool escaped;
+                if (!scanString(key, keyLen, escaped) || !match(':'))
+                    return false;
+
+                // An escaped key is compared once decoded.  If it's the
+                // one we want, it's left to the full parser.
+                if (escaped) {
+                    if (!decodeString(key, keyLen, decodedKey)
+                        || column[index].compareString(decodedKey.data(),
+                                                       decodedKey.size()) == 0)
+                        return false;
+                    if (!skipValue(index + 1))
+                        return false;
+                    continue;
+                }
+
+                if (column[index].compareString(key, keyLen) != 0) {
+                    if (!skipValue(index + 1))
+                        return false;
+                    continue;
+                }
+
+                // The full parser keeps both members with the same key
+                if (!result.empty())
+                    return false;
+
+                skipWhitespace();
+                ExpressionValue value;
+                if (index + 1 < column.size() && p < e && *p == '{') {
+                    if (!extractObject(column, index + 1, timestamp, value))
+                        return false;
+                }
+                else {
+                    const char * start = p;
+                    if (!skipValue(index + 1))
+                        return false;
+                    StreamingJsonParsingContext parser("parse_json", start,
+                                                       p - start);
+                    value = ExpressionValue::parseJson(parser, timestamp,
+                                                       PARSE_ARRAYS);
+                }
+                result.emplace_back(column[index], std::move(value));
+            } while (match(','));
+
+            if (!match('}'))
+                return false;
+        }
+
+        output = ExpressionValue(std::move(result));
+        return true;
+    }
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* JSON COLUMN EXTRACTION                                                    */
+/*****************************************************************************/
+
+bool tryExtractJsonColumn(const char * json, size_t length,
+                          const ColumnPath & column,
+                          Date timestamp,
+                          const VariableFilter & filter,
+                          ExpressionValue & result)
+{
+    if (column.empty())
+        return false;
+
+    JsonScanner scanner(json, json + length);
+    ExpressionValue object;
+    if (!scanner.extractObject(column, 0, timestamp, object))
+        return false;
+
+    // Anything after the object is for the full parser to deal with
+    scanner.skipWhitespace();
+    if (scanner.p != scanner.e)
+        return false;
+
+    result = object.getNestedColumn(column, filter);
+    return true;
+}
+
+} // namespace MLDB
@@ -0,0 +1,41 @@
+/** json_extract.h                                                 -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Extraction of a single field of a JSON document without parsing the
+    rest of it.
+*/
+
+#pragma once
+
+#include "mldb/sql/expression_value.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* JSON COLUMN EXTRACTION                                                    */
+/*****************************************************************************/
+
+/** Return the nested column of the JSON object in [json, json + length)
+    in result, without building the values that aren't on its path.  The
+    result is the same as
+
+        ExpressionValue::parseJson(parser, timestamp, PARSE_ARRAYS)
+            .getNestedColumn(column, filter)
+
+    The rest of the document is still scanned, so that the same documents
+    are rejected: only the values that are read are built.
+
+    Returns false, leaving result untouched, for documents that this
+    can't be sure to handle the same way: those that are malformed or not
+    an object, or that have a key with escapes or the same key twice on
+    the path of the column.  They need to be parsed in full.
+*/
+bool tryExtractJsonColumn(const char * json, size_t length,
+                          const ColumnPath & column,
+                          Date timestamp,
+                          const VariableFilter & filter,
+                          ExpressionValue & result);
+
+} // namespace MLDB
@@ -0,0 +1,634 @@
+/** msgpack.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    MessagePack encoding of ExpressionValues.
+*/
+
+#include "mldb/sql/msgpack.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/base/exc_assert.h"
+#include <cmath>
+#include <cstring>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+const char * const MSGPACK_CONTENT_TYPE = "application/msgpack";
+
+namespace {
+
+/// Extension type of timestamps, from the MessagePack specification
+constexpr int8_t TIMESTAMP_EXT = -1;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* MSGPACK WRITER                                                            */
+/*****************************************************************************/
+
+void
+MsgPackWriter::
+writeBigEndian(uint64_t val, int n)
+{
+    for (int i = n - 1;  i >= 0;  --i)
+        bytes.push_back((char)(val >> (i * 8)));
+}
+
+void
+MsgPackWriter::
+writeHeader(uint8_t fix, uint8_t code8, uint8_t code16, uint8_t code32,
+            int fixMax, size_t n)
+{
+    if (fixMax >= 0 && n <= (size_t)fixMax) {
+        bytes.push_back((char)(fix | n));
+    }
+    else if (code8 && n < 0x100) {
+        bytes.push_back((char)code8);
+        writeBigEndian(n, 1);
+    }
+    else if (n < 0x10000) {
+        bytes.push_back((char)code16);
+        writeBigEndian(n, 2);
+    }
+    else if (n <= 0xffffffffULL) {
+        bytes.push_back((char)code32);
+        writeBigEndian(n, 4);
+    }
+    else {
+        throw AnnotatedException(400, "value is too long for MessagePack",
+                                 "length", n);
+    }
+}
+
+void
+MsgPackWriter::
+writeNil()
+{
+    bytes.push_back((char)0xc0);
+}
+
+void
+MsgPackWriter::
+writeBool(bool val)
+{
+    bytes.push_back((char)(val ? 0xc3 : 0xc2));
+}
+
+void
+MsgPackWriter::
+writeUInt(uint64_t val)
+{
+    if (val < 0x80) {
+        bytes.push_back((char)val);
+    }
+    else if (val < 0x100) {
+        bytes.push_back((char)0xcc);
+        writeBigEndian(val, 1);
+    }
+    else if (val < 0x10000) {
+        bytes.push_back((char)0xcd);
+        writeBigEndian(val, 2);
+    }
+    else if (val <= 0xffffffffULL) {
+        bytes.push_back((char)0xce);
+        writeBigEndian(val, 4);
+    }
+    else {
+        bytes.push_back((char)0xcf);
+        writeBigEndian(val, 8);
+    }
+}
+
+void
+MsgPackWriter::
+writeInt(int64_t val)
+{
+    if (val >= 0) {
+        writeUInt(val);
+    }
+    else if (val >= -32) {
+        bytes.push_back((char)val);
+    }
+    else if (val >= INT8_MIN) {
+        bytes.push_back((char)0xd0);
+        writeBigEndian(val, 1);
+    }
+    else if (val >= INT16_MIN) {
+        bytes.push_back((char)0xd1);
+        writeBigEndian(val, 2);
+    }
+    else if (val >= INT32_MIN) {
+        bytes.push_back((char)0xd2);
+        writeBigEndian(val, 4);
+    }
+    else {
+        bytes.push_back((char)0xd3);
+        writeBigEndian(val, 8);
+    }
+}
+
+void
+MsgPackWriter::
+writeDouble(double val)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &val, sizeof(bits));
+    bytes.push_back((char)0xcb);
+    writeBigEndian(bits, 8);
+}
+
+void
+MsgPackWriter::
+writeString(const char * data, size_t len)
+{
+    writeHeader(0xa0, 0xd9, 0xda, 0xdb, 31, len);
+    bytes.append(data, len);
+}
+
+void
+MsgPackWriter::
+writeBinary(const char * data, size_t len)
+{
+    writeHeader(0, 0xc4, 0xc5, 0xc6, -1, len);
+    bytes.append(data, len);
+}
+
+void
+MsgPackWriter::
+writeTimestamp(Date ts)
+{
+    if (!ts.isADate()) {
+        writeNil();
+        return;
+    }
+
+    double secs = ts.secondsSinceEpoch();
+    double wholeSecs = std::floor(secs);
+    int64_t sec = wholeSecs;
+    int64_t nsec = std::llround((secs - wholeSecs) * 1e9);
+    if (nsec >= 1000000000) {
+        sec += 1;
+        nsec -= 1000000000;
+    }
+
+    // Use the smallest of the three forms that holds the value
+    if (sec >= 0 && (sec >> 34) == 0) {
+        if (nsec == 0 && (sec >> 32) == 0) {
+            bytes.push_back((char)0xd6);
+            bytes.push_back((char)TIMESTAMP_EXT);
+            writeBigEndian(sec, 4);
+        }
+        else {
+            bytes.push_back((char)0xd7);
+            bytes.push_back((char)TIMESTAMP_EXT);
+            writeBigEndian(((uint64_t)nsec << 34) | sec, 8);
+        }
+    }
+    else {
+        bytes.push_back((char)0xc7);
+        bytes.push_back((char)12);
+        bytes.push_back((char)TIMESTAMP_EXT);
+        writeBigEndian(nsec, 4);
+        writeBigEndian(sec, 8);
+    }
+}
+
+void
+MsgPackWriter::
+startArray(size_t n)
+{
+    writeHeader(0x90, 0, 0xdc, 0xdd, 15, n);
+}
+
+void
+MsgPackWriter::
+startMap(size_t n)
+{
+    writeHeader(0x80, 0, 0xde, 0xdf, 15, n);
+}
+
+void
+MsgPackWriter::
+write(const CellValue & val)
+{
+    switch (val.cellType()) {
+    case CellValue::EMPTY:
+        writeNil();
+        return;
+    case CellValue::INTEGER:
+        if (val.isUnsignedInteger())
+            writeUInt(val.toUInt());
+        else writeInt(val.toInt());
+        return;
+    case CellValue::FLOAT:
+        writeDouble(val.toDouble());
+        return;
+    case CellValue::ASCII_STRING:
+    case CellValue::UTF8_STRING:
+        writeString(val.stringChars(), val.toStringLength());
+        return;
+    case CellValue::TIMESTAMP:
+        writeTimestamp(val.toTimestamp());
+        return;
+    case CellValue::BLOB:
+        writeBinary((const char *)val.blobData(), val.blobLength());
+        return;
+    case CellValue::TIMEINTERVAL:
+    case CellValue::PATH:
+    default: {
+        Utf8String str = val.toUtf8String();
+        writeString(str.rawData(), str.rawLength());
+        return;
+    }
+    }
+}
+
+void
+MsgPackWriter::
+writeEmbedding(const CellValue * & cell, const DimsVector & shape, size_t dim)
+{
+    startArray(shape[dim]);
+    for (size_t i = 0;  i < shape[dim];  ++i) {
+        if (dim == shape.size() - 1)
+            write(*cell++);
+        else writeEmbedding(cell, shape, dim + 1);
+    }
+}
+
+void
+MsgPackWriter::
+write(const ExpressionValue & val)
+{
+    if (val.empty()) {
+        writeNil();
+    }
+    else if (val.isAtom()) {
+        write(val.getAtom());
+    }
+    else if (val.isEmbedding()) {
+        DimsVector shape = val.getEmbeddingShape();
+        std::vector<CellValue> cells = val.getEmbeddingCell();
+        const CellValue * cell = cells.data();
+        if (shape.empty())
+            startArray(0);
+        else writeEmbedding(cell, shape, 0);
+        ExcAssertEqual(cell, cells.data() + cells.size());
+    }
+    else if (val.isSuperposition()) {
+        write(val.extractJson());
+    }
+    else {
+        // Like JSON, a row with columns 0, 1, 2, ... is an array
+        size_t n = 0;
+        bool isArray = true;
+        auto onCount = [&] (const PathElement & name,
+                            const ExpressionValue &)
+            {
+                if (isArray && name.toIndex() != (ssize_t)n)
+                    isArray = false;
+                ++n;
+                return true;
+            };
+        val.forEachColumn(onCount);
+
+        if (isArray)
+            startArray(n);
+        else startMap(n);
+
+        auto onColumn = [&] (const PathElement & name,
+                             const ExpressionValue & value)
+            {
+                if (!isArray) {
+                    if (name.hasStringView()) {
+                        const char * start;
+                        size_t len;
+                        std::tie(start, len) = name.getStringView();
+                        writeString(start, len);
+                    }
+                    else {
+                        Utf8String str = name.toUtf8String();
+                        writeString(str.rawData(), str.rawLength());
+                    }
+                }
+                write(value);
+                return true;
+            };
+        val.forEachColumn(onColumn);
+    }
+}
+
+void
+MsgPackWriter::
+write(const Json::Value & val)
+{
+    switch (val.type()) {
+    case Json::nullValue:
+        writeNil();
+        return;
+    case Json::intValue:
+        writeInt(val.asInt());
+        return;
+    case Json::uintValue:
+        writeUInt(val.asUInt());
+        return;
+    case Json::realValue:
+        writeDouble(val.asDouble());
+        return;
+    case Json::stringValue: {
+        const char * str = val.asCString();
+        writeString(str, strlen(str));
+        return;
+    }
+    case Json::booleanValue:
+        writeBool(val.asBool());
+        return;
+    case Json::arrayValue:
+        startArray(val.size());
+        for (auto & v: val)
+            write(v);
+        return;
+    case Json::objectValue:
+        startMap(val.size());
+        for (auto it = val.begin(), end = val.end();  it != end;  ++it) {
+            std::string name = it.memberName();
+            writeString(name.data(), name.size());
+            write(*it);
+        }
+        return;
+    }
+    throw AnnotatedException(500, "unknown JSON value type");
+}
+
+
+/*****************************************************************************/
+/* MSGPACK READER                                                            */
+/*****************************************************************************/
+
+void
+MsgPackReader::
+error(const char * message) const
+{
+    throw AnnotatedException(400, std::string("Malformed MessagePack: ")
+                             + message);
+}
+
+uint8_t
+MsgPackReader::
+readByte()
+{
+    if (current == end)
+        error("unexpected end of data");
+    return (uint8_t)*current++;
+}
+
+const char *
+MsgPackReader::
+readBytes(size_t n)
+{
+    if (end - current < (ssize_t)n)
+        error("unexpected end of data");
+    const char * result = current;
+    current += n;
+    return result;
+}
+
+uint64_t
+MsgPackReader::
+readBigEndian(int n)
+{
+    const unsigned char * p = (const unsigned char *)readBytes(n);
+    uint64_t result = 0;
+    for (int i = 0;  i < n;  ++i)
+        result = (result << 8) | p[i];
+    return result;
+}
+
+size_t
+MsgPackReader::
+readLength(int n)
+{
+    return readBigEndian(n);
+}
+
+MsgPackReader::Kind
+MsgPackReader::
+peek() const
+{
+    if (current == end)
+        error("unexpected end of data");
+    uint8_t c = *current;
+    if (c <= 0x7f || c >= 0xe0)
+        return INT;
+    if (c <= 0x8f)
+        return MAP;
+    if (c <= 0x9f)
+        return ARRAY;
+    if (c <= 0xbf)
+        return STRING;
+
+    switch (c) {
+    case 0xc0: return NIL;
+    case 0xc2: case 0xc3: return BOOL;
+    case 0xc4: case 0xc5: case 0xc6: return BINARY;
+    case 0xc7: case 0xc8: case 0xc9: return EXT;
+    case 0xca: case 0xcb: return FLOAT;
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3: return INT;
+    case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8: return EXT;
+    case 0xd9: case 0xda: case 0xdb: return STRING;
+    case 0xdc: case 0xdd: return ARRAY;
+    case 0xde: case 0xdf: return MAP;
+    default:
+        error("unknown type byte");
+    }
+}
+
+size_t
+MsgPackReader::
+readArray()
+{
+    uint8_t c = readByte();
+    if (c >= 0x90 && c <= 0x9f)
+        return c & 0x0f;
+    if (c == 0xdc)
+        return readLength(2);
+    if (c == 0xdd)
+        return readLength(4);
+    error("expected an array");
+}
+
+size_t
+MsgPackReader::
+readMap()
+{
+    uint8_t c = readByte();
+    if (c >= 0x80 && c <= 0x8f)
+        return c & 0x0f;
+    if (c == 0xde)
+        return readLength(2);
+    if (c == 0xdf)
+        return readLength(4);
+    error("expected a map");
+}
+
+std::string_view
+MsgPackReader::
+readString()
+{
+    uint8_t c = readByte();
+    size_t len;
+    if (c >= 0xa0 && c <= 0xbf)
+        len = c & 0x1f;
+    else if (c == 0xd9)
+        len = readLength(1);
+    else if (c == 0xda)
+        len = readLength(2);
+    else if (c == 0xdb)
+        len = readLength(4);
+    else error("expected a string");
+    return std::string_view(readBytes(len), len);
+}
+
+CellValue
+MsgPackReader::
+readAtom()
+{
+    uint8_t c = readByte();
+
+    if (c <= 0x7f)
+        return CellValue((int)c);
+    if (c >= 0xe0)
+        return CellValue((int)(int8_t)c);
+    if (c >= 0xa0 && c <= 0xbf) {
+        --current;
+        std::string_view str = readString();
+        return CellValue(str.data(), str.size());
+    }
+
+    switch (c) {
+    case 0xc0: return CellValue();
+    case 0xc2: return CellValue(0);
+    case 0xc3: return CellValue(1);
+    case 0xc4: case 0xc5: case 0xc6: {
+        size_t len = readLength(1 << (c - 0xc4));
+        return CellValue::blob(readBytes(len), len);
+    }
+    case 0xca: {
+        uint32_t bits = readBigEndian(4);
+        float val;
+        std::memcpy(&val, &bits, sizeof(val));
+        return CellValue(val);
+    }
+    case 0xcb: {
+        uint64_t bits = readBigEndian(8);
+        double val;
+        std::memcpy(&val, &bits, sizeof(val));
+        return CellValue(val);
+    }
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+        return CellValue((unsigned long long)readBigEndian(1 << (c - 0xcc)));
+    case 0xd0: return CellValue((long long)(int8_t)readBigEndian(1));
+    case 0xd1: return CellValue((long long)(int16_t)readBigEndian(2));
+    case 0xd2: return CellValue((long long)(int32_t)readBigEndian(4));
+    case 0xd3: return CellValue((long long)(int64_t)readBigEndian(8));
+    case 0xd9: case 0xda: case 0xdb: {
+        --current;
+        std::string_view str = readString();
+        return CellValue(str.data(), str.size());
+    }
+    case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:
+    case 0xc7: case 0xc8: case 0xc9: {
+        size_t len;
+        if (c >= 0xd4)
+            len = 1 << (c - 0xd4);
+        else len = readLength(1 << (c - 0xc7));
+        int8_t type = readByte();
+        const char * data = readBytes(len);
+        if (type != TIMESTAMP_EXT)
+            error("only the timestamp extension type is understood");
+
+        MsgPackReader payload(data, len);
+        int64_t sec;
+        uint32_t nsec = 0;
+        if (len == 4) {
+            sec = payload.readBigEndian(4);
+        }
+        else if (len == 8) {
+            uint64_t bits = payload.readBigEndian(8);
+            nsec = bits >> 34;
+            sec = bits & ((1ULL << 34) - 1);
+        }
+        else if (len == 12) {
+            nsec = payload.readBigEndian(4);
+            sec = payload.readBigEndian(8);
+        }
+        else error("timestamp must be 4, 8 or 12 bytes");
+        return CellValue(Date::fromSecondsSinceEpoch(sec + nsec * 1e-9));
+    }
+    default:
+        error("expected an atom");
+    }
+}
+
+ExpressionValue
+MsgPackReader::
+readValue(Date ts)
+{
+    switch (peek()) {
+    case MAP: {
+        size_t n = readMap();
+        StructValue out;
+        out.reserve(n);
+        for (size_t i = 0;  i < n;  ++i) {
+            PathElement name;
+            if (peek() == INT)
+                name = PathElement(readAtom().toInt());
+            else {
+                std::string_view str = readString();
+                name = PathElement(str.data(), str.size());
+            }
+            out.emplace_back(std::move(name), readValue(ts));
+        }
+        return std::move(out);
+    }
+    case ARRAY: {
+        size_t n = readArray();
+        StructValue out;
+        out.reserve(n);
+        for (size_t i = 0;  i < n;  ++i)
+            out.emplace_back(PathElement(i), readValue(ts));
+        return std::move(out);
+    }
+    default:
+        return ExpressionValue(readAtom(), ts);
+    }
+}
+
+void
+MsgPackReader::
+skip()
+{
+    switch (peek()) {
+    case MAP: {
+        size_t n = readMap();
+        for (size_t i = 0;  i < 2 * n;  ++i)
+            skip();
+        return;
+    }
+    case ARRAY: {
+        size_t n = readArray();
+        for (size_t i = 0;  i < n;  ++i)
+            skip();
+        return;
+    }
+    default:
+        readAtom();
+    }
+}
+
+} // namespace MLDB
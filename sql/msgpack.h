@@ -0,0 +1,129 @@
+/** msgpack.h                                                      -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    MessagePack encoding of ExpressionValues, for clients that can't afford
+    to go through JSON.
+*/
+
+#pragma once
+
+#include "mldb/sql/expression_value.h"
+#include <string>
+#include <string_view>
+
+
+namespace MLDB {
+
+/// Content type of MessagePack requests and responses
+extern const char * const MSGPACK_CONTENT_TYPE;
+
+
+/*****************************************************************************/
+/* MSGPACK WRITER                                                            */
+/*****************************************************************************/
+
+/** Writes values in the MessagePack format (https://msgpack.org) into a
+    buffer of bytes.
+
+    Values map onto the format the same way that they map onto JSON, except
+    that there is no loss: blobs are written as binary, timestamps with the
+    timestamp extension type (-1) and floating point numbers with all of
+    their bits.  Intervals and paths are written as strings.
+*/
+
+struct MsgPackWriter {
+    std::string bytes;
+
+    void writeNil();
+    void writeBool(bool val);
+    void writeInt(int64_t val);
+    void writeUInt(uint64_t val);
+    void writeDouble(double val);
+    void writeString(const char * data, size_t len);
+    void writeString(std::string_view str)
+    {
+        writeString(str.data(), str.size());
+    }
+    void writeBinary(const char * data, size_t len);
+    void writeTimestamp(Date ts);
+
+    /// Start an array; the next n values written are its elements
+    void startArray(size_t n);
+
+    /// Start a map; the next 2n values written are its keys and values
+    void startMap(size_t n);
+
+    void write(const CellValue & val);
+    void write(const ExpressionValue & val);
+    void write(const Json::Value & val);
+
+private:
+    void writeHeader(uint8_t fix, uint8_t code8, uint8_t code16,
+                     uint8_t code32, int fixMax, size_t n);
+    void writeBigEndian(uint64_t val, int bytes);
+    void writeEmbedding(const CellValue * & cell, const DimsVector & shape,
+                        size_t dim);
+};
+
+
+/*****************************************************************************/
+/* MSGPACK READER                                                            */
+/*****************************************************************************/
+
+/** Reads values in the MessagePack format from a buffer of bytes, which
+    must outlive the reader.  Malformed or truncated input throws a 400
+    error.
+*/
+
+struct MsgPackReader {
+    MsgPackReader(const char * data, size_t len)
+        : current(data), end(data + len)
+    {
+    }
+
+    MsgPackReader(const std::string & data)
+        : MsgPackReader(data.data(), data.size())
+    {
+    }
+
+    enum Kind {
+        NIL, BOOL, INT, FLOAT, STRING, BINARY, ARRAY, MAP, EXT
+    };
+
+    /// Return the kind of the next value, without reading it
+    Kind peek() const;
+
+    bool eof() const { return current == end; }
+
+    /// Read the header of an array, returning its number of elements
+    size_t readArray();
+
+    /// Read the header of a map, returning its number of entries
+    size_t readMap();
+
+    /// Read a string, which points into the buffer
+    std::string_view readString();
+
+    /// Read any atomic value
+    CellValue readAtom();
+
+    /** Read any value.  Maps become rows, and arrays become rows whose
+        columns are numbered from 0, as they do from JSON.
+    */
+    ExpressionValue readValue(Date ts);
+
+    /// Skip the next value, whatever it is
+    void skip();
+
+private:
+    const char * current;
+    const char * end;
+
+    uint8_t readByte();
+    uint64_t readBigEndian(int bytes);
+    const char * readBytes(size_t n);
+    size_t readLength(int bytes);
+    [[noreturn]] void error(const char * message) const;
+};
+
+} // namespace MLDB
@@ -0,0 +1,97 @@
+/** query_explain.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Recording of the plan of a query.
+*/
+
+#include "mldb/sql/query_explain.h"
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* QUERY EXPLAIN NODE                                                        */
+/*****************************************************************************/
+
+QueryExplainNode::
+QueryExplainNode(Utf8String type, Json::Value details)
+    : type(std::move(type)), details(std::move(details)),
+      rowsIn(0), rowsOut(0), bytes(0), nanoseconds(0)
+{
+}
+
+std::shared_ptr<QueryExplainNode>
+QueryExplainNode::
+addChild(Utf8String type, Json::Value details)
+{
+    auto result = std::make_shared<QueryExplainNode>(std::move(type),
+                                                     std::move(details));
+    std::unique_lock<std::mutex> guard(mutex);
+    children.push_back(result);
+    return result;
+}
+
+Json::Value
+QueryExplainNode::
+toJson() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    Json::Value result;
+    result["type"] = type;
+    if (!details.isNull())
+        result["details"] = details;
+
+    uint64_t childRowsOut = 0;
+    uint64_t childNanoseconds = 0;
+    for (auto & c: children) {
+        childRowsOut += c->rowsOut;
+        childNanoseconds += c->nanoseconds;
+        result["children"].append(c->toJson());
+    }
+
+    uint64_t in = rowsIn;
+    result["rowsIn"] = in == 0 ? childRowsOut : in;
+    result["rowsOut"] = (uint64_t)rowsOut;
+    result["bytes"] = (uint64_t)bytes;
+
+    // Children that ran in parallel can take more time than their parent
+    uint64_t ns = nanoseconds;
+    result["wallTime"] = ns / 1e9;
+    result["selfTime"] = ns > childNanoseconds ? (ns - childNanoseconds) / 1e9 : 0.0;
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* QUERY EXPLAIN SCOPE                                                       */
+/*****************************************************************************/
+
+static __thread QueryExplainNode * currentExplainNode = nullptr;
+
+QueryExplainScope::
+QueryExplainScope(std::shared_ptr<QueryExplainNode> node)
+    : node(std::move(node)), previous(currentExplainNode)
+{
+    currentExplainNode = this->node.get();
+}
+
+QueryExplainScope::
+~QueryExplainScope()
+{
+    currentExplainNode = previous;
+}
+
+QueryExplainNode *
+QueryExplainScope::
+current()
+{
+    return currentExplainNode;
+}
+
+} // namespace MLDB
@@ -0,0 +1,132 @@
+/** query_explain.h                                                 -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Recording of the plan of a query, with the time spent and the rows
+    output by each of its steps.
+
+    Explaining is turned on for a thread by a QueryExplainScope.  The parts
+    of a query that are bound and started on that thread add a node for
+    themselves under the current node, and record their statistics into it
+    as the query runs.  When there is no scope, nothing is recorded and the
+    only cost is a check of a thread-local pointer when a query is bound.
+*/
+
+#pragma once
+
+#include "mldb/types/string.h"
+#include "mldb/ext/jsoncpp/value.h"
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <chrono>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* QUERY EXPLAIN NODE                                                        */
+/*****************************************************************************/
+
+/** One step of the plan of a query.  The statistics are atomic as the
+    step may be run from several threads at once.
+*/
+
+struct QueryExplainNode {
+    QueryExplainNode(Utf8String type = "", Json::Value details = Json::Value());
+
+    /// Type of the step, for example FilterWhereElement or SelectQuery
+    Utf8String type;
+
+    /// Anything else that describes the step, such as the algorithm used
+    /// to find the rows.  Only to be modified on the thread that added it.
+    Json::Value details;
+
+    /// Rows read by the step.  If it's zero, the rows output by the
+    /// children of the step are reported instead.
+    std::atomic<uint64_t> rowsIn;
+
+    /// Rows output by the step
+    std::atomic<uint64_t> rowsOut;
+
+    /// Approximate number of bytes of values output by the step
+    std::atomic<uint64_t> bytes;
+
+    /// Total wall time spent in the step, including in its children
+    std::atomic<uint64_t> nanoseconds;
+
+    /// Add a child step, returning it
+    std::shared_ptr<QueryExplainNode>
+    addChild(Utf8String type, Json::Value details = Json::Value());
+
+    /// Record that the step ran for the given time
+    void addTime(std::chrono::steady_clock::duration elapsed)
+    {
+        nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>
+            (elapsed).count();
+    }
+
+    /** Return the step and its children as JSON.  As well as the wall
+        time, this returns the time spent in the step itself, which is what
+        is left once the time spent in its children is taken out.
+    */
+    Json::Value toJson() const;
+
+private:
+    mutable std::mutex mutex;
+    std::vector<std::shared_ptr<QueryExplainNode> > children;
+};
+
+
+/*****************************************************************************/
+/* QUERY EXPLAIN SCOPE                                                       */
+/*****************************************************************************/
+
+/** While in scope, the queries bound or started on this thread record
+    their plan under the given node.  Scopes nest, so a part of a query
+    makes itself the current node while it binds the parts below it.  A
+    null node turns explaining off.
+*/
+
+struct QueryExplainScope {
+    QueryExplainScope(std::shared_ptr<QueryExplainNode> node);
+    ~QueryExplainScope();
+
+    /// Return the node to record under, or null if not explaining
+    static QueryExplainNode * current();
+
+private:
+    std::shared_ptr<QueryExplainNode> node;
+    QueryExplainNode * previous;
+};
+
+
+/*****************************************************************************/
+/* QUERY EXPLAIN TIMER                                                       */
+/*****************************************************************************/
+
+/** Adds the time that it's in scope to a node.  Does nothing if the node
+    is null.
+*/
+
+struct QueryExplainTimer {
+    QueryExplainTimer(QueryExplainNode * node)
+        : node(node)
+    {
+        if (node)
+            start = std::chrono::steady_clock::now();
+    }
+
+    ~QueryExplainTimer()
+    {
+        if (node)
+            node->addTime(std::chrono::steady_clock::now() - start);
+    }
+
+private:
+    QueryExplainNode * node;
+    std::chrono::steady_clock::time_point start;
+};
+
+} // namespace MLDB
@@ -8,11 +8,245 @@
 #include "mldb/types/annotated_exception.h"
 #include "mldb/sql/builtin_functions.h"
 #include "mldb/types/basic_value_descriptions.h"
+#include "mldb/utils/lru_cache.h"
+#include <atomic>
+#include <cstring>
 
 using namespace std;
 
 namespace MLDB {
 
+
+/*****************************************************************************/
+/* LIKE PATTERN                                                              */
+/*****************************************************************************/
+
+LikePattern
+LikePattern::
+parse(const Utf8String & pattern)
+{
+    LikePattern result;
+    result.segments.emplace_back();
+
+    for (char c: pattern.rawString()) {
+        switch (c) {
+        case '%':
+            result.segments.emplace_back();
+            break;
+        case '_':
+            // Matches a single character, which may be several bytes
+            return LikePattern();
+        case '+': case '?': case '{': case '}': case '\\':
+            // These are passed through to the regex by likeToRegex, so
+            // the regex needs to be run to keep the same meaning
+            return LikePattern();
+        default:
+            result.segments.back() += c;
+        }
+    }
+
+    result.isSimple = true;
+    return result;
+}
+
+bool
+LikePattern::
+matches(const char * data, size_t length) const
+{
+    ExcAssert(isSimple);
+
+    const std::string & first = segments.front();
+    if (segments.size() == 1) {
+        return length == first.size()
+            && memcmp(data, first.data(), length) == 0;
+    }
+
+    const std::string & last = segments.back();
+    if (length < first.size() + last.size())
+        return false;
+    if (memcmp(data, first.data(), first.size()) != 0)
+        return false;
+    if (memcmp(data + length - last.size(), last.data(), last.size()) != 0)
+        return false;
+
+    // The middle segments need to be found in order in what's left; taking
+    // the first occurrence of each leaves the most space for those after
+    const char * p = data + first.size();
+    const char * end = data + length - last.size();
+    for (size_t i = 1;  i + 1 < segments.size();  ++i) {
+        const std::string & segment = segments[i];
+        if (segment.empty())
+            continue;
+        const void * found = memmem(p, end - p, segment.data(), segment.size());
+        if (!found)
+            return false;
+        p = (const char *)found + segment.size();
+    }
+
+    return true;
+}
+
+
+/*****************************************************************************/
+/* COMPILED REGEX                                                            */
+/*****************************************************************************/
+
+bool
+CompiledRegex::
+mayContainMatch(const char * data, size_t length) const
+{
+    if (requiredLiteral.empty())
+        return true;
+    return memmem(data, length,
+                  requiredLiteral.data(), requiredLiteral.size()) != nullptr;
+}
+
+/// Return the position of the ] that closes the character class that
+/// starts at the [ at position i, or the length of s if it doesn't close.
+static size_t skipCharacterClass(const std::string & s, size_t i)
+{
+    ++i;
+    if (i < s.size() && s[i] == '^')
+        ++i;
+    if (i < s.size() && s[i] == ']')
+        ++i;  // a leading ] is part of the class
+    for (;  i < s.size() && s[i] != ']';  ++i) {
+        if (s[i] == '\\')
+            ++i;
+    }
+    return std::min(i, s.size());
+}
+
+/// Return the position of the ) that closes the group that starts at the
+/// ( at position i, or the length of s if it doesn't close.
+static size_t skipGroup(const std::string & s, size_t i)
+{
+    int depth = 0;
+    for (;  i < s.size();  ++i) {
+        switch (s[i]) {
+        case '\\':
+            ++i;
+            break;
+        case '[':
+            i = skipCharacterClass(s, i);
+            break;
+        case '(':
+            ++depth;
+            break;
+        case ')':
+            if (--depth == 0)
+                return i;
+            break;
+        default:
+            break;
+        }
+    }
+    return s.size();
+}
+
+std::string
+regexRequiredLiteral(const Utf8String & regex, bool & isLiteral)
+{
+    isLiteral = false;
+
+    const std::string & s = regex.rawString();
+
+    // Inline flags (for example case insensitivity) and quoting change the
+    // meaning of what follows them, so we don't try to analyze those
+    if (s.find("(?") != std::string::npos || s.find("\\Q") != std::string::npos)
+        return "";
+
+    // We look for the longest run of plain characters that must all be
+    // matched in sequence.  Anything more complicated ends the run.
+    std::string best, current;
+    bool lastWasLiteral = false;
+    bool onlyLiterals = true;
+
+    auto endRun = [&] ()
+        {
+            if (current.size() > best.size())
+                best = current;
+            current.clear();
+            lastWasLiteral = false;
+            onlyLiterals = false;
+        };
+
+    for (size_t i = 0;  i < s.size();  ++i) {
+        char c = s[i];
+        switch (c) {
+        case '|':
+            // Any of the alternatives may match
+            return "";
+        case '?':
+        case '*':
+            // The previous character is optional
+            if (lastWasLiteral)
+                current.pop_back();
+            endRun();
+            break;
+        case '{':
+            // Counted repetition, which may be zero
+            if (lastWasLiteral)
+                current.pop_back();
+            endRun();
+            i = s.find('}', i);
+            if (i == std::string::npos)
+                return best;
+            break;
+        case '+':
+            // The previous character is needed, but what follows may not
+            // be next to it
+            endRun();
+            break;
+        case '[':
+            endRun();
+            i = skipCharacterClass(s, i);
+            break;
+        case '(':
+            endRun();
+            i = skipGroup(s, i);
+            break;
+        case ')':
+            return "";
+        case '.':
+        case '^':
+        case '$':
+            endRun();
+            break;
+        case '\\': {
+            if (i + 1 == s.size())
+                return "";
+            char escaped = s[++i];
+            if (isalnum(escaped) || (escaped & 0x80)) {
+                // Character class, anchor, backreference, etc
+                endRun();
+            }
+            else {
+                current += escaped;
+                lastWasLiteral = true;
+            }
+            break;
+        }
+        default:
+            if (c & 0x80) {
+                // Part of a multi-byte character; a following quantifier
+                // would apply to all of it, so we keep it simple
+                endRun();
+            }
+            else {
+                current += c;
+                lastWasLiteral = true;
+            }
+        }
+    }
+
+    isLiteral = onlyLiterals;
+    if (current.size() > best.size())
+        best = current;
+    return best;
+}
+
+
 /*****************************************************************************/
 /* REGEX HELPER                                                              */
 /*****************************************************************************/
@@ -26,8 +260,11 @@ void
 RegexHelper::
 init(BoundSqlExpression expr_, int argNumber)
 {
+    static std::atomic<uint64_t> nextCacheId(0);
+
     expr = std::move(expr_);
     this->argNumber = argNumber;
+    this->cacheId = ++nextCacheId;
 
     if (expr.info->isConst()) {
         isPrecompiled = true;
@@ -36,7 +273,7 @@ init(BoundSqlExpression expr_, int argNumber)
     else isPrecompiled = false;
 }
 
-Regex
+CompiledRegex
 RegexHelper::
 compile(const ExpressionValue & val) const
 {
@@ -51,8 +288,9 @@ compile(const ExpressionValue & val) const
              "expr", expr,
              "value", val);
     }
+    CompiledRegex result;
     try {
-        return Regex(std::move(regexStr));
+        result.regex = Regex(regexStr);
     } MLDB_CATCH_ALL {
         rethrowException
             (400, "Error when compiling regex '"
@@ -63,8 +301,32 @@ compile(const ExpressionValue & val) const
              "expr", expr,
              "value", val);
     }
+    result.requiredLiteral = regexRequiredLiteral(regexStr, result.isLiteral);
+    return result;
 }
 
+namespace {
+
+/// Key of a regex cached for a given helper
+struct RegexCacheKey {
+    uint64_t helper;
+    Utf8String pattern;
+
+    bool operator == (const RegexCacheKey & other) const
+    {
+        return helper == other.helper && pattern == other.pattern;
+    }
+};
+
+struct RegexCacheKeyHash {
+    size_t operator () (const RegexCacheKey & key) const
+    {
+        return std::hash<Utf8String>()(key.pattern) ^ key.helper;
+    }
+};
+
+} // file scope
+
 ExpressionValue
 RegexHelper::
 operator () (const std::vector<ExpressionValue> & args,
@@ -73,9 +335,25 @@ operator () (const std::vector<ExpressionValue> & args,
     if (isPrecompiled) {
         return apply(args, scope, precompiled);
     }
-    else {
-        return apply(args, scope, compile(args.at(argNumber)));
+
+    const ExpressionValue & val = args.at(argNumber);
+    if (!val.isString()) {
+        // Nulls and errors; not worth caching
+        return apply(args, scope, compile(val));
     }
+
+    // Each thread has its own cache so that it's not contended when a
+    // query runs in parallel
+    static thread_local LruCache<RegexCacheKey,
+                                 std::shared_ptr<const CompiledRegex>,
+                                 RegexCacheKeyHash>
+        cache(CACHE_SIZE);
+
+    auto compiled = cache.getOrCreate
+        (RegexCacheKey{cacheId, val.toUtf8String()},
+         [&] () { return std::make_shared<const CompiledRegex>(compile(val)); });
+
+    return apply(args, scope, *compiled);
 }
 
 
@@ -93,15 +371,23 @@ ExpressionValue
 ApplyRegexReplace::
 apply(const std::vector<ExpressionValue> & args,
       const SqlRowScope & scope,
-      const Regex & regex) const
+      const CompiledRegex & regex) const
 {
     checkArgsSize(args.size(), 3);
 
     if (args[0].empty() || args[1].empty() || args[2].empty())
         return ExpressionValue::null(calcTs(args[0], args[1], args[2]));
 
-    auto result = regex_replace(args[0].toUtf8String(),
-                                regex,
+    Utf8String str = args[0].toUtf8String();
+
+    // Without a match, there is nothing to replace
+    if (!regex.mayContainMatch(str.rawData(), str.rawLength())) {
+        return ExpressionValue(std::move(str),
+                               calcTs(args[0], args[1], args[2]));
+    }
+
+    auto result = regex_replace(str,
+                                regex.regex,
                                 args[2].toUtf8String());
     
     return ExpressionValue(std::move(result), calcTs(args[0], args[1], args[2]));
@@ -122,7 +408,7 @@ ExpressionValue
 ApplyRegexMatch::
 apply(const std::vector<ExpressionValue> & args,
       const SqlRowScope & scope,
-      const Regex & regex) const
+      const CompiledRegex & regex) const
 {
     // TODO: should be able to pass utf-8 string directly in
 
@@ -131,7 +417,13 @@ apply(const std::vector<ExpressionValue> & args,
     if (args[0].empty() || args[1].empty())
         return ExpressionValue::null(calcTs(args[0], args[1]));
 
-    bool result = regex_match(args[0].toUtf8String(), regex);
+    Utf8String str = args[0].toUtf8String();
+    bool result;
+    if (regex.isLiteral)
+        result = str.rawString() == regex.requiredLiteral;
+    else result = regex.mayContainMatch(str.rawData(), str.rawLength())
+             && regex_match(str, regex.regex);
+
     return ExpressionValue(result, calcTs(args[0], args[1]));
 }
 
@@ -150,7 +442,7 @@ ExpressionValue
 ApplyRegexSearch::
 apply(const std::vector<ExpressionValue> & args,
       const SqlRowScope & scope,
-      const Regex & regex) const
+      const CompiledRegex & regex) const
 {
     // TODO: should be able to pass utf-8 string directly in
 
@@ -159,7 +451,10 @@ apply(const std::vector<ExpressionValue> & args,
     if (args[0].empty() || args[1].empty())
         return ExpressionValue::null(calcTs(args[0], args[1]));
 
-    bool result = regex_search(args[0].toUtf8String(), regex);
+    Utf8String str = args[0].toUtf8String();
+    bool result = regex.mayContainMatch(str.rawData(), str.rawLength())
+        && (regex.isLiteral || regex_search(str, regex.regex));
+
     return ExpressionValue(result, calcTs(args[0], args[1]));
 }
 
@@ -237,14 +532,26 @@ Utf8String likeToRegex(const Utf8String& filterString)
     return regExFilter;
 }
 
-Regex
+CompiledRegex
 ApplyLike::
 compile(const ExpressionValue & val) const
 {
     if (val.empty()) {
-        return Regex();
+        return CompiledRegex();
     }
-    Utf8String regexStr = likeToRegex(val.toUtf8String());
+
+    Utf8String pattern = val.toUtf8String();
+
+    // Most patterns can be matched with string comparisons, in which case
+    // there is no need for the regex
+    LikePattern like = LikePattern::parse(pattern);
+    if (like.isSimple) {
+        CompiledRegex result;
+        result.like = std::move(like);
+        return result;
+    }
+
+    Utf8String regexStr = likeToRegex(pattern);
     ExpressionValue regexVal(std::move(regexStr), val.getEffectiveTimestamp());
     return RegexHelper::compile(regexVal);
 }
@@ -253,11 +560,11 @@ ExpressionValue
 ApplyLike::
 apply(const std::vector<ExpressionValue> & args,
       const SqlRowScope & scope,
-      const Regex & regex) const
+      const CompiledRegex & regex) const
 {
     checkArgsSize(args.size(), 2);
 
-    if (!regex.initialized()) {
+    if (!regex.like.isSimple && !regex.regex.initialized()) {
         return ExpressionValue::null(Date::negativeInfinity());
     }
 
@@ -269,7 +576,12 @@ apply(const std::vector<ExpressionValue> & args,
             (400, "LIKE expression must have string on left side");
     }
     
-    bool result = regex_match(args[0].toUtf8String(), regex);
+    Utf8String str = args[0].toUtf8String();
+    bool result;
+    if (regex.like.isSimple)
+        result = regex.like.matches(str.rawData(), str.rawLength());
+    else result = regex.mayContainMatch(str.rawData(), str.rawLength())
+             && regex_match(str, regex.regex);
 
     if (isNegative)
         result = !result;
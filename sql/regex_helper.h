@@ -12,12 +12,77 @@
 namespace MLDB {
 
 
+/*****************************************************************************/
+/* LIKE PATTERN                                                              */
+/*****************************************************************************/
+
+/** Analysis of a LIKE pattern that allows it to be matched with simple
+    string comparisons rather than a regex.  This is possible when the
+    only wildcard is %, for example 'abc', 'abc%', '%abc' or '%abc%'.
+*/
+struct LikePattern {
+    /// Analyze the given pattern
+    static LikePattern parse(const Utf8String & pattern);
+
+    /// Can it be matched without the regex?
+    bool isSimple = false;
+
+    /// Literal parts between the % wildcards.  There is always one more
+    /// than the number of wildcards; the first and the last are
+    /// anchored to the start and end of the string and may be empty.
+    std::vector<std::string> segments;
+
+    /// Does the UTF-8 string match the pattern?  Only if isSimple.
+    bool matches(const char * data, size_t length) const;
+};
+
+
+/*****************************************************************************/
+/* COMPILED REGEX                                                            */
+/*****************************************************************************/
+
+/** A compiled regex, along with what we know about the strings it can
+    match that allows most non-matching strings to be rejected without
+    running the regex engine.
+*/
+struct CompiledRegex {
+    Regex regex;
+
+    /// String that any match of the regex must contain; empty if there is
+    /// none we could find
+    std::string requiredLiteral;
+
+    /// Does the regex match exactly requiredLiteral and nothing else?
+    bool isLiteral = false;
+
+    /// For LIKE expressions, the analysis of the pattern
+    LikePattern like;
+
+    /// Can the string (in UTF-8) contain a match of the regex?  If it
+    /// returns false there is no need to run the regex.
+    bool mayContainMatch(const char * data, size_t length) const;
+};
+
+/** Return a literal string that must occur in any string matching the
+    given regex (with default flags), and sets isLiteral to whether the
+    regex matches nothing but that literal.  This is conservative; when
+    it's not obvious what must be in a match (for example, with an
+    alternation) an empty string is returned.
+*/
+std::string regexRequiredLiteral(const Utf8String & regex, bool & isLiteral);
+
+
 /*****************************************************************************/
 /* REGEX HELPER                                                              */
 /*****************************************************************************/
 
 /** Helper class that takes care of regular expression application whether
     it's a constant value or not.
+
+    Regexes that aren't constant are compiled when they are first seen
+    and kept in a small per-thread cache, so that repeated values (which
+    are typical when the pattern comes from a column) are only compiled
+    once.
 */
 struct RegexHelper {
     RegexHelper();
@@ -33,13 +98,13 @@ struct RegexHelper {
 
     /// Called to take an expression and turn it into a regex that will be
     /// applied.  Default simply compiles a standard regex.
-    virtual Regex compile(const ExpressionValue & val) const;
+    virtual CompiledRegex compile(const ExpressionValue & val) const;
 
     /// The expression that the regex came from, to help with error messages
     BoundSqlExpression expr;
 
     /// The pre-compiled version of that expression, when it's constant
-    Regex precompiled;
+    CompiledRegex precompiled;
 
     /// Is it actually constant (and precompiled), or computed on the fly?
     bool isPrecompiled;
@@ -48,12 +113,18 @@ struct RegexHelper {
     /// constant?
     int argNumber;
 
+    /// Identifies the helper (and its copies) in the cache of regexes
+    uint64_t cacheId;
+
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const Regex & regex) const = 0;
+                                  const CompiledRegex & regex) const = 0;
 
     ExpressionValue operator () (const std::vector<ExpressionValue> & args,
                                  const SqlRowScope & scope);
+
+    /// Number of non-constant regexes each thread keeps compiled
+    static constexpr size_t CACHE_SIZE = 64;
 };
 
 
@@ -66,7 +137,7 @@ struct ApplyRegexReplace: public RegexHelper {
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const Regex & regex) const;
+                                  const CompiledRegex & regex) const;
 };
 
 
@@ -79,7 +150,7 @@ struct ApplyRegexMatch: public RegexHelper {
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const Regex & regex) const;
+                                  const CompiledRegex & regex) const;
 };
 
 
@@ -92,7 +163,7 @@ struct ApplyRegexSearch: public RegexHelper {
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const Regex & regex) const;
+                                  const CompiledRegex & regex) const;
 };
 
 
@@ -107,11 +178,11 @@ struct ApplyLike: public RegexHelper {
 
     /// For the LIKE expression, there is a different syntax to standard
     /// regular expressions, which we deal with here.
-    virtual Regex compile(const ExpressionValue & val) const;
+    virtual CompiledRegex compile(const ExpressionValue & val) const;
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const Regex & regex) const;
+                                  const CompiledRegex & regex) const;
 
     /// This inverts it, ie turns LIKE into NOT LIKE
     bool isNegative;
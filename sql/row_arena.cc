@@ -0,0 +1,190 @@
+/** row_arena.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Arena for the temporary structures of a batch of rows.
+*/
+
+#include "mldb/sql/row_arena.h"
+#include <cstdlib>
+#include <new>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ROW ARENA                                                                 */
+/*****************************************************************************/
+
+namespace {
+
+/// Each allocation is preceded by a header recording which block it
+/// came from (or null if it was allocated on its own), which keeps the
+/// allocations aligned for any type.
+constexpr size_t HEADER_SIZE = alignof(std::max_align_t);
+
+size_t roundUp(size_t bytes)
+{
+    return (bytes + HEADER_SIZE - 1) & ~(HEADER_SIZE - 1);
+}
+
+std::atomic<size_t> numBlocks(0);
+
+} // file scope
+
+struct RowArena::Block {
+    /// One reference for each allocation that hasn't been freed, plus one
+    /// for the arena while it's allocating from the block
+    std::atomic<size_t> refs;
+    size_t used;
+    size_t size;
+
+    static Block * create(size_t size)
+    {
+        void * mem = ::malloc(roundUp(sizeof(Block)) + size);
+        if (!mem)
+            throw std::bad_alloc();
+        ++numBlocks;
+        return new (mem) Block{ {1}, 0, size };
+    }
+
+    char * data()
+    {
+        return reinterpret_cast<char *>(this) + roundUp(sizeof(Block));
+    }
+
+    void release()
+    {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            this->~Block();
+            ::free(this);
+            --numBlocks;
+        }
+    }
+
+    /// Is the arena's reference the only one left?
+    bool unused() const
+    {
+        return refs.load(std::memory_order_acquire) == 1;
+    }
+};
+
+RowArena::
+RowArena(size_t blockSize)
+    : current(nullptr), blockSize(blockSize)
+{
+}
+
+RowArena::
+~RowArena()
+{
+    retire();
+}
+
+void *
+RowArena::
+allocate(size_t bytes)
+{
+    size_t total = roundUp(bytes) + HEADER_SIZE;
+
+    char * result;
+    Block * block = nullptr;
+
+    if (total > blockSize / 4) {
+        // Big enough that it's not worth taking space from a block
+        result = static_cast<char *>(::malloc(total));
+        if (!result)
+            throw std::bad_alloc();
+    }
+    else {
+        if (current && current->used + total > current->size) {
+            // Full.  If everything allocated from it has already been
+            // freed, we can simply start again at the beginning.
+            if (current->unused())
+                current->used = 0;
+            else retire();
+        }
+        if (!current)
+            current = Block::create(blockSize);
+
+        block = current;
+        result = block->data() + block->used;
+        block->used += total;
+        block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    *reinterpret_cast<Block **>(result) = block;
+    return result + HEADER_SIZE;
+}
+
+void
+RowArena::
+deallocate(void * mem)
+{
+    if (!mem)
+        return;
+    char * start = static_cast<char *>(mem) - HEADER_SIZE;
+    Block * block = *reinterpret_cast<Block **>(start);
+    if (block)
+        block->release();
+    else ::free(start);
+}
+
+void
+RowArena::
+newBatch()
+{
+    if (!current)
+        return;
+    if (current->unused())
+        current->used = 0;
+    else retire();
+}
+
+void
+RowArena::
+retire()
+{
+    if (current)
+        current->release();
+    current = nullptr;
+}
+
+size_t
+RowArena::
+numLiveBlocks()
+{
+    return numBlocks;
+}
+
+
+/*****************************************************************************/
+/* ROW ARENA SCOPE                                                           */
+/*****************************************************************************/
+
+static __thread RowArena * currentArena = nullptr;
+
+RowArenaScope::
+RowArenaScope(RowArena * arena)
+    : previous(currentArena)
+{
+    currentArena = arena;
+}
+
+RowArenaScope::
+~RowArenaScope()
+{
+    currentArena = previous;
+}
+
+RowArena *
+RowArenaScope::
+current()
+{
+    return currentArena;
+}
+
+} // namespace MLDB
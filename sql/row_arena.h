@@ -0,0 +1,141 @@
+/** row_arena.h                                                    -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Arena from which the temporary structures of a batch of rows are
+    allocated.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ROW ARENA                                                                 */
+/*****************************************************************************/
+
+/** Memory from which the structured values created while a pipeline
+    processes a batch of rows are allocated.
+
+    Memory is taken from large blocks by bumping a pointer.  Freeing
+    memory only decrements a count on its block; a block is returned to
+    the system once the arena has moved on from it and everything that
+    was allocated from it has been freed.  Values that outlive their batch
+    (for example the rows of the output) keep their block alive, so this
+    is always safe; it's efficient when, as is typical, most values die
+    with their batch.
+
+    Allocation must only be done by one thread at a time (the one running
+    the pipeline element that owns the arena), but memory can be freed
+    from any thread.
+*/
+struct RowArena {
+    RowArena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+    ~RowArena();
+
+    RowArena(const RowArena &) = delete;
+    void operator = (const RowArena &) = delete;
+
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+    /// Allocate memory, which must be released with deallocate().
+    void * allocate(size_t bytes);
+
+    /// Free memory allocated from any arena
+    static void deallocate(void * mem);
+
+    /** Start a new batch of rows.  If everything allocated for the
+        previous batch has been freed its block is reused; otherwise new
+        allocations are made from a new block, so that the memory of the
+        previous batch can be freed as soon as its values are.
+    */
+    void newBatch();
+
+    /// Number of blocks that are still allocated.  For testing.
+    static size_t numLiveBlocks();
+
+private:
+    struct Block;
+    Block * current;
+    size_t blockSize;
+
+    void retire();
+};
+
+
+/*****************************************************************************/
+/* ROW ARENA ALLOCATOR                                                       */
+/*****************************************************************************/
+
+/** Standard allocator that allocates from a RowArena, to be used with
+    std::allocate_shared.
+*/
+template<typename T>
+struct RowArenaAllocator {
+    typedef T value_type;
+
+    RowArenaAllocator(RowArena * arena) noexcept
+        : arena(arena)
+    {
+    }
+
+    template<typename U>
+    RowArenaAllocator(const RowArenaAllocator<U> & other) noexcept
+        : arena(other.arena)
+    {
+    }
+
+    T * allocate(size_t n)
+    {
+        return static_cast<T *>(arena->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T * p, size_t)
+    {
+        RowArena::deallocate(p);
+    }
+
+    template<typename U>
+    bool operator == (const RowArenaAllocator<U> & other) const
+    {
+        return arena == other.arena;
+    }
+
+    template<typename U>
+    bool operator != (const RowArenaAllocator<U> & other) const
+    {
+        return arena != other.arena;
+    }
+
+    RowArena * arena;
+};
+
+
+/*****************************************************************************/
+/* ROW ARENA SCOPE                                                           */
+/*****************************************************************************/
+
+/** Makes the structured values created by this thread be allocated
+    from the given arena until it's destroyed.  A null arena makes them
+    be allocated normally.  Scopes can be nested.
+*/
+struct RowArenaScope {
+    RowArenaScope(RowArena * arena);
+    ~RowArenaScope();
+
+    RowArenaScope(const RowArenaScope &) = delete;
+    void operator = (const RowArenaScope &) = delete;
+
+    /// Return the arena to allocate from in this thread, or null if none
+    static RowArena * current();
+
+private:
+    RowArena * previous;
+};
+
+} // namespace MLDB
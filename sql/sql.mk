@@ -13,12 +13,17 @@ $(eval $(call library,sql_types,$(SQL_TYPES_SOURCES),types utils value_descripti
 SQL_EXPRESSION_SOURCES := \
 	cell_value.cc \
 	sql_expression.cc \
+	sql_batch.cc \
+	arrow_writer.cc \
 	expression_value.cc \
+	msgpack.cc \
+	value_snapshot.cc \
 	table_expression_operations.cc \
 	binding_contexts.cc \
 	builtin_functions.cc \
 	builtin_geo_functions.cc \
 	builtin_image_functions.cc \
+	image_decoding.cc \
 	builtin_http_functions.cc \
 	builtin_dataset_functions.cc \
 	builtin_aggregators.cc \
@@ -28,8 +33,11 @@ SQL_EXPRESSION_SOURCES := \
 	join_utils.cc \
 	tokenize.cc \
 	regex_helper.cc \
+	json_extract.cc \
 	execution_pipeline.cc \
 	execution_pipeline_impl.cc \
+	query_explain.cc \
+	row_arena.cc \
 	sql_utils.cc \
 	sql_expression_operations.cc \
 	eval_sql.cc \
@@ -40,8 +48,11 @@ SQL_EXPRESSION_SOURCES := \
 # aren't prefixed.
 $(eval $(call set_compile_option,cell_value.cc builtin_geo_functions.cc,$(S2_COMPILE_OPTIONS) $(S2_WARNING_OPTIONS)))
 
+# The configuration header of the JPEG library is generated when it's built
+$(CWD)/image_decoding.cc: $(JPEG_INCLUDE_FILES)
+
 # NOTE: the SQL library should NOT depend on MLDB.  See the comment in testing/testing.mk
-$(eval $(call library,sql_expression,$(SQL_EXPRESSION_SOURCES),sql_types utils value_description any json_diff highwayhash hash s2 edlib log pffft easyexif progress magic))
+$(eval $(call library,sql_expression,$(SQL_EXPRESSION_SOURCES),sql_types block utils value_description any json_diff highwayhash hash s2 edlib log pffft easyexif jpeg progress magic))
 
 $(eval $(call include_sub_make,sql_testing,testing,sql_testing.mk))
 
@@ -0,0 +1,354 @@
+/** sql_batch.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Batch execution of bound SQL expressions.
+*/
+
+#include "sql_batch.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/base/exc_assert.h"
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SQL BATCH VECTOR                                                          */
+/*****************************************************************************/
+
+size_t
+SqlBatchVector::
+size() const
+{
+    switch (kind) {
+    case INTEGER:  return ints.size();
+    case DOUBLE:   return doubles.size();
+    case ATOM:     return atoms.size();
+    }
+    throw AnnotatedException(500, "Unknown batch vector kind");
+}
+
+void
+SqlBatchVector::
+initIntegers(size_t n)
+{
+    kind = INTEGER;
+    ints.clear();
+    ints.resize(n);
+    doubles.clear();
+    atoms.clear();
+    nulls.clear();
+}
+
+void
+SqlBatchVector::
+initDoubles(size_t n)
+{
+    kind = DOUBLE;
+    doubles.clear();
+    doubles.resize(n);
+    ints.clear();
+    atoms.clear();
+    nulls.clear();
+}
+
+void
+SqlBatchVector::
+initAtoms(size_t n)
+{
+    kind = ATOM;
+    atoms.clear();
+    atoms.resize(n);
+    ints.clear();
+    doubles.clear();
+    nulls.clear();
+}
+
+void
+SqlBatchVector::
+initConstant(const CellValue & value, size_t n)
+{
+    if (value.isInt64()) {
+        initIntegers(n);
+        std::fill(ints.begin(), ints.end(), value.toInt());
+    }
+    else if (value.isDouble()) {
+        initDoubles(n);
+        std::fill(doubles.begin(), doubles.end(), value.toDouble());
+    }
+    else {
+        initAtoms(n);
+        std::fill(atoms.begin(), atoms.end(), value);
+    }
+}
+
+void
+SqlBatchVector::
+initCells(std::vector<CellValue> values)
+{
+    bool allIntegers = true;
+    bool allDoubles = true;
+
+    for (auto & v: values) {
+        if (v.empty())
+            continue;
+        if (!v.isInt64())
+            allIntegers = false;
+        // Unsigned integers beyond the range of int64_t don't compare the
+        // same way once they've been through a double, so they stay atoms
+        if (!v.isDouble() && !(v.isInt64() && v.isExactDouble()))
+            allDoubles = false;
+        if (!allIntegers && !allDoubles)
+            break;
+    }
+
+    size_t n = values.size();
+
+    if (allIntegers) {
+        initIntegers(n);
+        for (size_t i = 0;  i < n;  ++i) {
+            if (values[i].empty())
+                setNull(i);
+            else ints[i] = values[i].toInt();
+        }
+    }
+    else if (allDoubles) {
+        initDoubles(n);
+        for (size_t i = 0;  i < n;  ++i) {
+            if (values[i].empty())
+                setNull(i);
+            else doubles[i] = values[i].toDouble();
+        }
+    }
+    else {
+        initAtoms(0);
+        atoms = std::move(values);
+    }
+}
+
+void
+SqlBatchVector::
+makeAtoms()
+{
+    if (kind == ATOM)
+        return;
+
+    size_t n = size();
+    std::vector<CellValue> values;
+    values.reserve(n);
+    for (size_t i = 0;  i < n;  ++i)
+        values.emplace_back(getCell(i));
+
+    initAtoms(0);
+    atoms = std::move(values);
+}
+
+void
+SqlBatchVector::
+setNull(size_t i)
+{
+    if (kind == ATOM) {
+        atoms[i] = CellValue();
+        return;
+    }
+    if (nulls.empty())
+        nulls.resize(size());
+    nulls[i] = 1;
+}
+
+CellValue
+SqlBatchVector::
+getCell(size_t i) const
+{
+    switch (kind) {
+    case INTEGER:
+        if (isNull(i))
+            return CellValue();
+        return ints[i];
+    case DOUBLE:
+        if (isNull(i))
+            return CellValue();
+        return doubles[i];
+    case ATOM:
+        return atoms[i];
+    }
+    throw AnnotatedException(500, "Unknown batch vector kind");
+}
+
+bool
+SqlBatchVector::
+isTrue(size_t i) const
+{
+    switch (kind) {
+    case INTEGER:  return !isNull(i) && ints[i];
+    case DOUBLE:   return !isNull(i) && doubles[i];
+    case ATOM:     return atoms[i].isTrue();
+    }
+    throw AnnotatedException(500, "Unknown batch vector kind");
+}
+
+bool
+SqlBatchVector::
+isFalse(size_t i) const
+{
+    switch (kind) {
+    case INTEGER:  return !isNull(i) && !ints[i];
+    case DOUBLE:   return !isNull(i) && !doubles[i];
+    case ATOM:     return atoms[i].isFalse();
+    }
+    throw AnnotatedException(500, "Unknown batch vector kind");
+}
+
+void
+SqlBatchVector::
+set(size_t i, const SqlBatchVector & other, size_t j)
+{
+    if (kind != other.kind)
+        makeAtoms();
+
+    if (kind == ATOM) {
+        atoms[i] = other.getCell(j);
+        return;
+    }
+
+    if (other.isNull(j)) {
+        setNull(i);
+        return;
+    }
+
+    if (!nulls.empty())
+        nulls[i] = 0;
+
+    if (kind == INTEGER)
+        ints[i] = other.ints[j];
+    else doubles[i] = other.doubles[j];
+}
+
+void
+SqlBatchVector::
+append(const SqlBatchVector & other)
+{
+    size_t n = size();
+    size_t m = other.size();
+
+    if (n == 0) {
+        *this = other;
+        return;
+    }
+    if (m == 0)
+        return;
+
+    if (kind != other.kind)
+        makeAtoms();
+
+    if (kind == ATOM) {
+        atoms.reserve(n + m);
+        for (size_t j = 0;  j < m;  ++j)
+            atoms.emplace_back(other.getCell(j));
+        return;
+    }
+
+    if (!nulls.empty() || !other.nulls.empty()) {
+        nulls.resize(n);
+        if (other.nulls.empty())
+            nulls.resize(n + m);
+        else nulls.insert(nulls.end(), other.nulls.begin(), other.nulls.end());
+    }
+
+    if (kind == INTEGER)
+        ints.insert(ints.end(), other.ints.begin(), other.ints.end());
+    else doubles.insert(doubles.end(), other.doubles.begin(), other.doubles.end());
+}
+
+
+/*****************************************************************************/
+/* SQL BATCH                                                                 */
+/*****************************************************************************/
+
+SqlBatch::
+~SqlBatch()
+{
+}
+
+
+/*****************************************************************************/
+/* BATCH EXECUTION                                                           */
+/*****************************************************************************/
+
+SqlSelection
+selectAll(size_t numRows)
+{
+    SqlSelection result(numRows);
+    for (size_t i = 0;  i < numRows;  ++i)
+        result[i] = i;
+    return result;
+}
+
+bool
+isBatchable(const BoundSqlExpression & expr)
+{
+    return expr.info
+        && expr.info->isScalar()
+        && !expr.info->isEmbedding()
+        && !expr.info->isRow();
+}
+
+void
+evalBatch(const BoundSqlExpression & expr,
+          const SqlBatch & batch,
+          const SqlSelection & selection,
+          SqlBatchVector & out)
+{
+    if (expr.batchExec) {
+        expr.batchExec(batch, selection, out);
+        ExcAssertEqual(out.size(), selection.size());
+        return;
+    }
+
+    // Constants were folded when they were bound, so are the same for
+    // every row
+    if (expr.info && expr.info->isConst()) {
+        out.initConstant(expr.constantValue().getAtom(), selection.size());
+        return;
+    }
+
+    // Not supported in batch mode; have the batch run it for each row
+    std::vector<CellValue> values;
+    values.reserve(selection.size());
+    for (uint32_t row: selection) {
+        values.emplace_back(batch.evalRow(expr, row).getAtom());
+    }
+    out.initCells(std::move(values));
+}
+
+SqlSelection
+filterBatch(const BoundSqlExpression & expr,
+            const SqlBatch & batch,
+            const SqlSelection & selection)
+{
+    SqlBatchVector values;
+    evalBatch(expr, batch, selection, values);
+
+    SqlSelection result;
+    result.reserve(selection.size());
+    for (size_t i = 0;  i < selection.size();  ++i) {
+        if (values.isTrue(i))
+            result.push_back(selection[i]);
+    }
+    return result;
+}
+
+BoundSqlExpression::BatchExecFunction
+batchConstant(CellValue value)
+{
+    return [=] (const SqlBatch & batch,
+                const SqlSelection & selection,
+                SqlBatchVector & out)
+        {
+            out.initConstant(value, selection.size());
+        };
+}
+
+} // namespace MLDB
@@ -0,0 +1,200 @@
+/** sql_batch.h                                                    -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Batch execution of bound SQL expressions.
+
+    In row mode, a bound expression is executed once per row via its exec
+    function, which constructs an ExpressionValue for each node of the
+    expression tree.  In batch mode, it is executed once for a whole batch
+    of rows via its batchExec function: each node produces a vector with
+    the value for each selected row, and operations on numbers are tight
+    loops over typed arrays.
+
+    Nodes that don't support batch mode are executed a row at a time by
+    the batch, so a whole tree can be executed in batch mode as long as all
+    of the values within it are atoms.
+*/
+
+#pragma once
+
+#include "sql_expression.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SQL BATCH VECTOR                                                          */
+/*****************************************************************************/
+
+/** The values of an atom-valued expression for the selected rows of a
+    batch, one per entry of the selection in the same order.
+
+    Numbers are kept in typed arrays where possible:
+    - INTEGER keeps its values in ints.  Element v has the same meaning as
+      CellValue(v); booleans are 0 and 1, as in row mode.
+    - DOUBLE keeps its values in doubles.  Element d has the same meaning
+      as CellValue(d), which is an integer when d is integral.
+    - ATOM keeps its values in atoms, which may be empty.
+
+    For INTEGER and DOUBLE, nulls is either empty, meaning that there are
+    no null values, or has an entry for each value which is non-zero if the
+    value is null.
+*/
+
+struct SqlBatchVector {
+    enum Kind {
+        INTEGER,
+        DOUBLE,
+        ATOM
+    };
+
+    Kind kind = ATOM;
+    std::vector<int64_t> ints;
+    std::vector<double> doubles;
+    std::vector<CellValue> atoms;
+    std::vector<uint8_t> nulls;
+
+    /// Number of values in the vector
+    size_t size() const;
+
+    /// Is this an INTEGER or DOUBLE vector?
+    bool isNumeric() const
+    {
+        return kind != ATOM;
+    }
+
+    /// Make this an INTEGER vector of n non-null zeros
+    void initIntegers(size_t n);
+
+    /// Make this a DOUBLE vector of n non-null zeros
+    void initDoubles(size_t n);
+
+    /// Make this an ATOM vector of n nulls
+    void initAtoms(size_t n);
+
+    /// Make this a vector with n copies of the given value
+    void initConstant(const CellValue & value, size_t n);
+
+    /** Make this a vector holding the given values, using a typed array
+        if they are all integers or all numbers that can be held exactly
+        as a double.
+    */
+    void initCells(std::vector<CellValue> values);
+
+    /// Convert the vector in place to an ATOM vector
+    void makeAtoms();
+
+    /// Set the value at position i to null
+    void setNull(size_t i);
+
+    bool isNull(size_t i) const
+    {
+        if (kind == ATOM)
+            return atoms[i].empty();
+        return !nulls.empty() && nulls[i];
+    }
+
+    /// Return the value at position i as a double.  Must be numeric.
+    double getDouble(size_t i) const
+    {
+        return kind == INTEGER ? ints[i] : doubles[i];
+    }
+
+    /// Return the value at position i
+    CellValue getCell(size_t i) const;
+
+    /// Same as getCell(i).isTrue()
+    bool isTrue(size_t i) const;
+
+    /// Same as getCell(i).isFalse()
+    bool isFalse(size_t i) const;
+
+    /** Set the value at position i to the value at position j of other,
+        converting this vector to an ATOM vector if other is of a
+        different kind.
+    */
+    void set(size_t i, const SqlBatchVector & other, size_t j);
+
+    /** Add the values of other to the end of this vector, converting it
+        to an ATOM vector if other is of a different kind.
+    */
+    void append(const SqlBatchVector & other);
+};
+
+
+/*****************************************************************************/
+/* SQL BATCH                                                                 */
+/*****************************************************************************/
+
+/** A batch of rows over which expressions are executed in batch mode.  It
+    is implemented by whatever is executing the expression, and provides
+    the values of the columns and the row scopes.
+*/
+
+struct SqlBatch {
+    SqlBatch(size_t numRows = 0)
+        : numRows(numRows)
+    {
+    }
+
+    virtual ~SqlBatch();
+
+    /// Number of rows in the batch, which are numbered from zero
+    size_t numRows;
+
+    /** Read the value of the given column for the selected rows into out.
+        Returns false if the column can't be read as atoms, in which case
+        it will be read a row at a time with evalRow().  A column that
+        doesn't exist is null.
+    */
+    virtual bool readColumn(const ColumnPath & columnName,
+                            const SqlSelection & selection,
+                            SqlBatchVector & out) const = 0;
+
+    /** Execute the expression in row mode for the given row of the batch.
+        This is used for the nodes that don't support batch mode.
+    */
+    virtual ExpressionValue evalRow(const BoundSqlExpression & expr,
+                                    uint32_t row) const = 0;
+};
+
+
+/*****************************************************************************/
+/* BATCH EXECUTION                                                           */
+/*****************************************************************************/
+
+/** Return the selection of all rows of a batch with the given number of
+    rows.
+*/
+SqlSelection selectAll(size_t numRows);
+
+/** Can the expression be executed as part of a batch?  This is true when
+    its value is always an atom, whether or not it provides a batchExec
+    function.
+*/
+bool isBatchable(const BoundSqlExpression & expr);
+
+/** Execute the expression for the selected rows of the batch, writing the
+    value for each into out.  This uses the batchExec function if the
+    expression has one, and otherwise executes it a row at a time.  The
+    expression must be batchable.
+*/
+void evalBatch(const BoundSqlExpression & expr,
+               const SqlBatch & batch,
+               const SqlSelection & selection,
+               SqlBatchVector & out);
+
+/** Return the rows of the selection for which the expression is true, as
+    it is tested by a WHERE clause.
+*/
+SqlSelection filterBatch(const BoundSqlExpression & expr,
+                         const SqlBatch & batch,
+                         const SqlSelection & selection);
+
+/** Return a batchExec function that returns the given value for every
+    row.
+*/
+BoundSqlExpression::BatchExecFunction batchConstant(CellValue value);
+
+} // namespace MLDB
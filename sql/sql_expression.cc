@@ -384,6 +384,13 @@ doGetColumn(const Utf8String & tableName, const ColumnPath & columnName)
                               + columnName.toUtf8String());
 }
 
+BatchColumnGetter
+SqlBindingScope::
+doGetColumnBatch(const Utf8String & tableName, const ColumnPath & columnName)
+{
+    return BatchColumnGetter();
+}
+
 GetAllColumnsOutput
 SqlBindingScope::
 doGetAllColumns(const Utf8String & tableName,
@@ -476,6 +483,15 @@ getMldbEngine() const
     return nullptr;
 }
 
+int
+SqlBindingScope::
+getSharedSubexpressionSlot(const Utf8String & printed)
+{
+    if (!sharedSubexpressions)
+        return -1;
+    return sharedSubexpressions->getSlot(printed);
+}
+
 /*****************************************************************************/
 /* SCOPED NAME                                                               */
 /*****************************************************************************/
@@ -701,6 +717,45 @@ UnboundEntitiesDescription()
 }
 
 
+/*****************************************************************************/
+/* SHARED SUBEXPRESSIONS                                                     */
+/*****************************************************************************/
+
+int
+SharedSubexpressions::
+getSlot(const Utf8String & printed)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    return slots.emplace(printed, slots.size()).first->second;
+}
+
+size_t
+SharedSubexpressions::
+size() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    return slots.size();
+}
+
+
+/*****************************************************************************/
+/* SHARED SUBEXPRESSION VALUES                                               */
+/*****************************************************************************/
+
+void
+SharedSubexpressionValues::
+insert(int slot, const ExpressionValue & value)
+{
+    ExcAssertGreaterEqual(slot, 0);
+    if ((size_t)slot >= values.size()) {
+        values.resize(slot + 1);
+        done.resize(slot + 1);
+    }
+    values[slot] = value;
+    done[slot] = true;
+}
+
+
 /*****************************************************************************/
 /* SQL ROW SCOPE                                                             */
 /*****************************************************************************/
@@ -788,8 +843,21 @@ static bool matchPathIdentifier(ParseContext & context,
         if (isdigit(*context))
             return false;
 
-        while (context && (isalnum(*context) || *context == '_'))
-            result += *context++;
+        // Take the identifier a buffer at a time, rather than appending
+        // it one character at a time
+        std::string chars;
+        while (context) {
+            const char * start = context.get_buffer_pos();
+            const char * end = context.get_buffer_end();
+            const char * p = start;
+            while (p < end && (isalnum(*p) || *p == '_'))
+                ++p;
+            chars.append(start, p);
+            context.advance_in_buffer(p - start);
+            if (p < end)
+                break;
+        }
+        result += chars;
     }
     return !result.empty();
 }
@@ -814,16 +882,17 @@ static ColumnPath matchColumnName(ParseContext & context, bool allowUtf8)
         return result;
     }
 
-    result = PathElement(std::move(first));
+    PathBuilder builder;
+    builder.add(PathElement(std::move(first)));
 
     while (context.match_literal('.')) {
         Utf8String next = matchIdentifier(context, allowUtf8);
         if (next.empty())
             break;  // will happen for a *
-        result = result + next;
+        builder.add(PathElement(std::move(next)));
     }
 
-    return result;
+    return builder.extract();
 }
 
 bool matchBlockCommentStart(ParseContext & ctx)
@@ -924,9 +993,24 @@ void expect_whitespace(ParseContext & ctx)
     if (!match_whitespace(ctx)) ctx.exception("expected whitespace");
 }
 
+// Can the keyword match here?  Nearly all failed matches fail on the
+// first character, which we check without setting up a token to
+// backtrack with.  Whitespace and comments need to be skipped first, so
+// they always need the full match.
+static bool keywordMayMatch(ParseContext & context, const char * keyword)
+{
+    if (context.eof())
+        return false;
+    char c = *context;
+    return isspace(c) || c == '/' || c == '-' || tolower(c) == tolower(*keyword);
+}
+
 // Match a keyword in any case
 static bool matchKeyword(ParseContext & context, const char * keyword)
 {
+    if (!keywordMayMatch(context, keyword))
+        return false;
+
     ParseContext::Revert_Token token(context);
 
     skip_whitespace(context);
@@ -967,6 +1051,8 @@ static void expectKeyword(ParseContext & context, const char * keyword)
 // Read ahead to see if a keyword matches
 static bool peekKeyword(ParseContext & context, const char * keyword)
 {
+    if (!keywordMayMatch(context, keyword))
+        return false;
     ParseContext::Revert_Token token(context);
     return matchKeyword(context, keyword);
 }
@@ -1100,10 +1186,49 @@ bool matchConstant(ParseContext & context, ExpressionValue & result,
     else return false;
 }
 
+/** Elements of IN lists, literal arrays and function arguments are very
+    often plain numbers or strings, especially in generated queries.  This
+    parses one directly, without the general expression parser, as long as
+    it's the whole element: it must be followed by a comma or the closing
+    character.  Otherwise it returns null with nothing consumed, and the
+    element needs to be parsed as a full expression.
+*/
+std::shared_ptr<SqlExpression>
+matchConstantElement(ParseContext & context, char closing, bool allowUtf8)
+{
+    skip_whitespace(context);
+
+    // Anything else (for example a sign, which is a unary operator) needs
+    // the full parser to get the same result
+    if (context.eof() || (!isdigit(*context) && *context != '\''))
+        return nullptr;
+
+    ParseContext::Revert_Token token(context);
+    Utf8String surface;
+    ExpressionValue constant;
+    {
+        ParseContext::Hold_Token capture(context);
+        if (!matchConstant(context, constant, allowUtf8))
+            return nullptr;
+        surface = capture.captured();
+    }
+
+    skip_whitespace(context);
+    if (context.eof() || (*context != ',' && *context != closing))
+        return nullptr;
+
+    token.ignore();
+    auto result = std::make_shared<ConstantExpression>(std::move(constant));
+    result->surface = std::move(surface);
+    return result;
+}
 
 // Match an operator in any case
 static bool matchOperator(ParseContext & context, const char * keyword)
 {
+    if (context.eof() || tolower(*context) != tolower(*keyword))
+        return false;
+
     ParseContext::Revert_Token token(context);
 
     const char * p = keyword;
@@ -1310,7 +1435,9 @@ parse(ParseContext & context, int currentPrecedence, bool allowUtf8)
         if (!context.match_literal(']')) {
             do {
                 context.skip_whitespace();
-                auto expr = SqlExpression::parse(context, 10, allowUtf8);
+                auto expr = matchConstantElement(context, ']', allowUtf8);
+                if (!expr)
+                    expr = SqlExpression::parse(context, 10, allowUtf8);
                 context.skip_whitespace();
                 clauses.emplace_back(std::move(expr));
             } while (context.match_literal(','));
@@ -1426,9 +1553,11 @@ parse(ParseContext & context, int currentPrecedence, bool allowUtf8)
                         break;
                     }
 
-                    auto arg = parse(context,
-                                     10 /* precedence reset for comma */,
-                                     allowUtf8);
+                    auto arg = matchConstantElement(context, ')', allowUtf8);
+                    if (!arg)
+                        arg = parse(context,
+                                    10 /* precedence reset for comma */,
+                                    allowUtf8);
                     args.emplace_back(std::move(arg));
                     skip_whitespace(context);
                     
@@ -2227,8 +2356,26 @@ parse(ParseContext & context, bool allowUtf8)
     std::shared_ptr<SqlExpression> expr;
     ColumnPath columnName;
 
+    // Look at the leading name once to see which of the forms below can
+    // match, rather than trying each of them in turn.  Plain expressions,
+    // which most clauses of generated queries are, then go straight to
+    // the expression parser.
+    bool maybeWildcard = false;
+    bool maybeNamed = false;
     {
         ParseContext::Revert_Token token(context);
+        ColumnPath leading = matchColumnName(context, allowUtf8);
+        if (context.match_literal('*')) {
+            maybeWildcard = true;
+        }
+        else if (!leading.empty()) {
+            skip_whitespace(context);
+            maybeNamed = context.match_literal(':');
+        }
+    }
+
+    if (maybeWildcard) {
+        ParseContext::Revert_Token token(context);
 
         if (matchPrefixedWildcard(prefix)) {
             // Sort out ambiguity between * operator and wildcard by looking at trailing
@@ -2259,7 +2406,7 @@ parse(ParseContext & context, bool allowUtf8)
     }
 
     // MLDB-1002 case 1: x: y <--> y AS x
-    if (!matched) {
+    if (!matched && maybeNamed) {
         // Allow backtracking if we don't find a colon
         ParseContext::Revert_Token token(context);
 
@@ -2285,7 +2432,7 @@ parse(ParseContext & context, bool allowUtf8)
     }
 
     // MLDB-1002 case 2: x*: y* <--> y* AS x*
-    if (!matched) {
+    if (!matched && maybeWildcard) {
         // Allow backtracking if we don't find a colon
         ParseContext::Revert_Token token(context);
 
@@ -2876,7 +3023,9 @@ parse(ParseContext & context, bool allowUtf8)
     skip_whitespace(context);
 
     while (context) {
-        auto expr = SqlExpression::parse(context, 10 /* precedence */, allowUtf8);
+        auto expr = matchConstantElement(context, ')', allowUtf8);
+        if (!expr)
+            expr = SqlExpression::parse(context, 10 /* precedence */, allowUtf8);
 
         if (!expr)
             break;
@@ -3070,12 +3219,13 @@ SelectExpression::
 SelectExpression(std::vector<std::shared_ptr<SqlRowExpression> > clauses)
     : clauses(std::move(clauses))
 {
-    // concatenate all the surfaces with spaces
-    surface = std::accumulate(this->clauses.begin(), this->clauses.end(), Utf8String{},
-                              [](const Utf8String & prefix,
-                                 std::shared_ptr<SqlRowExpression> & next) {
-                                  return prefix.empty() ? next->surface : prefix + ", " + next->surface;
-                              });;
+    // concatenate all the surfaces with commas, in place so that it's not
+    // quadratic in the number of clauses
+    for (auto & clause: this->clauses) {
+        if (!surface.empty())
+            surface += ", ";
+        surface += clause->surface;
+    }
 }
 
 SelectExpression
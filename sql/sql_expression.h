@@ -15,8 +15,11 @@
 #include "mldb/types/any.h"
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/utils/progress.h"
+#include "mldb/arch/profile_scope.h"
 #include <memory>
 #include <set>
+#include <mutex>
+#include <unordered_map>
 
 // NOTE TO MLDB DEVELOPERS: This is an API header file.  No includes
 // should be added, especially value_description.h.  Only
@@ -78,6 +81,15 @@ struct BasicRowGenerator;
 struct WhenExpression;
 struct TableOperations;
 struct RowStream;
+struct SqlBatch;
+struct SqlBatchVector;
+struct SharedSubexpressions;
+struct SharedSubexpressionValues;
+
+/** A selection vector: the numbers of the rows of an SqlBatch that an
+    expression is evaluated on, in ascending order.  See sql_batch.h.
+*/
+typedef std::vector<uint32_t> SqlSelection;
 
 extern const OrderByExpression ORDER_BY_NOTHING;
 
@@ -162,6 +174,15 @@ struct BoundSqlExpression {
                                                    ExpressionValue & storage,
                                                    const VariableFilter & filter)> ExecFunction;
 
+    /** Function type to execute the expression for many rows at once.
+        This writes the value of the expression for each of the selected
+        rows of the batch into out, in selection order.  Only values are
+        produced, not timestamps.  See sql_batch.h.
+    */
+    typedef std::function<void (const SqlBatch & batch,
+                                const SqlSelection & selection,
+                                SqlBatchVector & out)> BatchExecFunction;
+
     BoundSqlExpression()
     {
     }
@@ -181,6 +202,27 @@ struct BoundSqlExpression {
     ExecFunction exec;
     std::shared_ptr<const SqlExpression> expr;
 
+    /** Optional function to execute the expression in batch mode.  This is
+        null for expressions that can only be executed a row at a time; use
+        evalBatch() to execute either way.
+    */
+    BatchExecFunction batchExec;
+
+    /** Function type to read a single nested column of the value of the
+        expression.
+    */
+    typedef std::function<ExpressionValue (const SqlRowScope & context,
+                                           const ColumnPath & column,
+                                           const VariableFilter & filter)>
+        ExtractColumnFunction;
+
+    /** Optional function that returns the same as
+        exec(context).getNestedColumn(column, filter), but without having to
+        build the rest of the value.  An extract that reads a single
+        column of the expression uses it.
+    */
+    ExtractColumnFunction extractColumn;
+
     /// What kind of value does this return?
     std::shared_ptr<ExpressionValueInfo> info;
 
@@ -194,6 +236,7 @@ struct BoundSqlExpression {
                  ExpressionValue & storage,
                  const VariableFilter & filter /*= GET_ALL*/) const
     {
+        MLDB_PROFILE_SCOPE("sql.expression");
         return exec(context, storage, filter);
     }
 
@@ -201,6 +244,7 @@ struct BoundSqlExpression {
     operator () (const SqlRowScope & context,
                  const VariableFilter & filter /*= GET_ALL*/) const
     {
+        MLDB_PROFILE_SCOPE("sql.expression");
         ExpressionValue storage;
         const ExpressionValue & res = exec(context, storage, filter);
         if (&res == &storage)
@@ -324,6 +368,15 @@ struct ColumnGetter {
     }
 };
 
+/** Function returned when we bind a column for batch execution.  This
+    reads the column for the selected rows of the batch into out, and
+    returns false if the column can't be read that way, in which case it
+    is read a row at a time instead.
+*/
+typedef std::function<bool (const SqlBatch & batch,
+                            const SqlSelection & selection,
+                            SqlBatchVector & out)> BatchColumnGetter;
+
 
 /*****************************************************************************/
 /* BOUND FUNCTION                                                            */
@@ -336,6 +389,8 @@ struct ColumnGetter {
 struct BoundFunction {
     typedef std::function<ExpressionValue (const std::vector<ExpressionValue> &,
                           const SqlRowScope & context) > Exec;
+    typedef std::function<void (const std::vector<SqlBatchVector> & args,
+                                SqlBatchVector & out)> BatchExec;
     typedef std::function<
         BoundSqlExpression (SqlBindingScope & scope,
                             std::vector<BoundSqlExpression>& boundArgs,
@@ -379,9 +434,35 @@ struct BoundFunction {
     std::shared_ptr<ExpressionValueInfo> resultInfo;
     VariableFilter filter; // allows function to filter variable as they need
 
+    /** True if the function always returns the same output for the same
+        arguments and row, which means that identical calls within a row
+        can share the result (see SharedSubexpressions).  Builtins set it
+        from their registration.
+    */
+    bool deterministic = false;
+
     /// If defined, overrides the default bindFunction call.
     BindFunction bindFunction;
 
+    /** If defined, applies the function to the arguments of many rows at
+        once, with one entry of out per entry of the arguments.  Only
+        functions of atoms that don't depend on the row scope can
+        provide it.
+    */
+    BatchExec batchExec;
+
+    typedef std::function<ExpressionValue (const std::vector<ExpressionValue> & args,
+                                           const ColumnPath & column,
+                                           const VariableFilter & filter)>
+        ExtractColumnExec;
+
+    /** If defined, returns the same as
+        exec(args, context).getNestedColumn(column, filter) without building
+        the rest of the result.  Only functions that don't depend on the
+        row scope can provide it.
+    */
+    ExtractColumnExec extractColumn;
+
     ExpressionValue operator () (const std::vector<ExpressionValue> & args,
                                  const SqlRowScope & context) const
     {
@@ -454,6 +535,12 @@ struct BoundAggregator {
     /// The type of the result of the function
     std::shared_ptr<ExpressionValueInfo> resultInfo;
 
+    /// Optional.  Return a copy of the state data, which can be merged
+    /// into another state without changing the original.  mergeInto may
+    /// take the contents of its source, so this allows a partial state
+    /// to be kept and merged more than once.
+    std::function<std::shared_ptr<void> (void *)> clone;
+
     operator bool () const { return !!init && !!process && !!extract && !!mergeInto; }
 };
 
@@ -657,6 +744,19 @@ struct SqlBindingScope {
     virtual ColumnGetter doGetColumn(const Utf8String & tableName,
                                      const ColumnPath & columnName);
 
+    /** Used to get the value of a column for a batch of rows.  This is
+        only called for columns that doGetColumn() says are atoms.  Scopes
+        that evaluate over batches return a function that reads the column
+        from the SqlBatch; the default returns a null function, which means
+        the column is read a row at a time.
+
+        A scope that overrides doGetColumn() without supporting batches
+        needs to override this to return a null function.
+    */
+    virtual BatchColumnGetter
+    doGetColumnBatch(const Utf8String & tableName,
+                     const ColumnPath & columnName);
+
     /** Used to resolve a wildcard expression.  This function returns
         another function that can be used to return a row containing just a
         subset of the columns where the names match.
@@ -748,7 +848,21 @@ struct SqlBindingScope {
     */
     virtual MldbEngine * getMldbEngine() const;
 
+    /** Return the slot of the given subexpression in the values shared
+        between the expressions bound in this scope, or -1 if the scope
+        doesn't share subexpressions.  The subexpression is identified by
+        its printed form.
+    */
+    int getSharedSubexpressionSlot(const Utf8String & printed);
+
     size_t functionStackDepth;
+
+    /** Subexpressions shared within this scope.  Null (the default) means
+        that subexpressions aren't shared; a scope whose row scopes can hold
+        the shared values (see SqlRowScope::getSharedSubexpressions) turns
+        sharing on by creating it.
+    */
+    std::shared_ptr<SharedSubexpressions> sharedSubexpressions;
 };
 
 
@@ -875,6 +989,69 @@ struct UnboundEntities {
 DECLARE_STRUCTURE_DESCRIPTION(UnboundEntities);
 
 
+/*****************************************************************************/
+/* SHARED SUBEXPRESSIONS                                                     */
+/*****************************************************************************/
+
+/** The subexpressions that occur more than once within the expressions
+    bound in one scope, for example parse_json(payload) in both the SELECT
+    and the GROUP BY of a query.  Each distinct subexpression gets a slot,
+    and its value for a row is kept in the row scope so that it's only
+    calculated once per row.
+*/
+
+struct SharedSubexpressions {
+    /// Return the slot for the given subexpression, allocating it if new
+    int getSlot(const Utf8String & printed);
+
+    /// Number of slots allocated
+    size_t size() const;
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<Utf8String, int> slots;
+};
+
+
+/*****************************************************************************/
+/* SHARED SUBEXPRESSION VALUES                                               */
+/*****************************************************************************/
+
+/** Values of the shared subexpressions for the row of a row scope.  They
+    are owned by the first SharedSubexpressions that uses them, so that a
+    row scope passed to expressions bound in different scopes only ever
+    holds the values of one of them.
+*/
+
+struct SharedSubexpressionValues {
+    /** Make the values belong to the given owner if they don't belong to
+        anyone yet.  Returns whether they belong to it.
+    */
+    bool claim(const SharedSubexpressions * owner)
+    {
+        if (!this->owner)
+            this->owner = owner;
+        return this->owner == owner;
+    }
+
+    /// Return the value of the slot, or null if it's not calculated yet
+    const ExpressionValue * find(int slot) const
+    {
+        if (slot < 0 || (size_t)slot >= done.size() || !done[slot])
+            return nullptr;
+        return &values[slot];
+    }
+
+    /// Record the value of the slot
+    void insert(int slot, const ExpressionValue & value);
+
+private:
+    const SharedSubexpressions * owner = nullptr;
+    std::vector<ExpressionValue> values;
+    std::vector<uint8_t> done;
+};
+
+
 /*****************************************************************************/
 /* SQL ROW SCOPE                                                             */
 /*****************************************************************************/
@@ -902,6 +1079,16 @@ struct SqlRowScope {
         return typeid(*this) != typeid(SqlRowScope);
     }
 
+    /** Return the storage for the values of the shared subexpressions of
+        the row, or null if this row scope can't hold them.  The values
+        must only ever be for one row, so a row scope that implements this
+        can't be reused for a different or modified row.
+    */
+    virtual SharedSubexpressionValues * getSharedSubexpressions() const
+    {
+        return nullptr;
+    }
+
     /** Throw an exception saying that the types requested were wrong. */
     static void throwBadNestingError(const std::type_info & typeRequested,
                                      const std::type_info & typeFound)
@@ -1530,6 +1717,7 @@ struct GenerateRowsWhereFunction {
                  const BoundParameters & params = BoundParameters(),
                  const ProgressFunc & onProgress = nullptr) const
     {
+        MLDB_PROFILE_SCOPE("sql.generateRowNames");
         return exec(numToGenerate, token, params, onProgress);
     }
 
@@ -1582,6 +1770,7 @@ struct BasicRowGenerator {
                  SqlRowScope & rowScope,
                  const BoundParameters & params = BoundParameters()) const
     {
+        MLDB_PROFILE_SCOPE("sql.generateRows");
         return exec(numToGenerate, rowScope, params);
     }
 
@@ -6,6 +6,7 @@
 */
 
 #include "sql_expression_operations.h"
+#include "sql_batch.h"
 #include "mldb/types/annotated_exception.h"
 #include <boost/algorithm/string.hpp>
 #include "mldb/types/structure_description.h"
@@ -55,14 +56,163 @@ static Date calcTs(const ExpressionValue & v1,
                     v2.getEffectiveTimestamp());
 }
 
+// Allow the operators specialized on the storage of their operands to be
+// turned off, to compare them with the generic ones.
+static OptimizedPath optimizeTypedScalarOperators
+    ("mldb.sql.typedScalarOperators");
+
+/// Does the info say that the values are integers, including booleans?
+static bool hasIntegerStorage(const ExpressionValueInfo & info)
+{
+    return dynamic_cast<const IntegerValueInfo *>(&info)
+        || dynamic_cast<const Uint64ValueInfo *>(&info)
+        || dynamic_cast<const BooleanValueInfo *>(&info);
+}
+
+/// Does the info say that the values are floating point numbers?
+static bool hasFloatStorage(const ExpressionValueInfo & info)
+{
+    return dynamic_cast<const Float64ValueInfo *>(&info)
+        || dynamic_cast<const Float32ValueInfo *>(&info)
+        || dynamic_cast<const NumericValueInfo *>(&info);
+}
+
+/** Read the value of an operand whose info says that it's stored as a
+    Storage, without the dynamic dispatch on the type of the CellValue.
+    The info doesn't stop a value from being null or, for a double that
+    happens to be integral, from being held as an integer; read() returns
+    false for those and the generic implementation of the operator is
+    used instead.
+*/
+template<typename Storage>
+struct ScalarStorage;
+
+template<>
+struct ScalarStorage<int64_t> {
+    static bool read(const CellValue & v, int64_t & out)
+    {
+        if (v.isDouble() || v.isUnsignedInteger() || !v.isInteger())
+            return false;
+        out = v.toInt();
+        return true;
+    }
+};
+
+template<>
+struct ScalarStorage<double> {
+    static bool read(const CellValue & v, double & out)
+    {
+        if (!v.isDouble())
+            return false;
+        out = v.toDouble();
+        return !std::isnan(out);
+    }
+};
+
+/** Compare the values of two batch vectors, with the same result as the
+    ExpressionValue comparison op.  Pairs of integers, and pairs of doubles
+    that aren't NaN, are compared directly with cmp.
+*/
+template<typename Cmp>
+static void
+batchComparison(const SqlBatchVector & l,
+                const SqlBatchVector & r,
+                bool (ExpressionValue::* op)(const ExpressionValue &) const,
+                const Cmp & cmp,
+                SqlBatchVector & out)
+{
+    size_t n = l.size();
+    out.initIntegers(n);
+
+    for (size_t i = 0;  i < n;  ++i) {
+        if (l.isNull(i) || r.isNull(i)) {
+            out.setNull(i);
+        }
+        else if (l.kind == SqlBatchVector::INTEGER
+                 && r.kind == SqlBatchVector::INTEGER) {
+            out.ints[i] = cmp(l.ints[i], r.ints[i]);
+        }
+        else if (l.kind == SqlBatchVector::DOUBLE
+                 && r.kind == SqlBatchVector::DOUBLE
+                 && !std::isnan(l.doubles[i]) && !std::isnan(r.doubles[i])) {
+            out.ints[i] = cmp(l.doubles[i], r.doubles[i]);
+        }
+        else {
+            ExpressionValue lv(l.getCell(i), Date::negativeInfinity());
+            ExpressionValue rv(r.getCell(i), Date::negativeInfinity());
+            out.ints[i] = (lv .* op)(rv);
+        }
+    }
+}
+
+/// Same as a.getCell(i) < b.getCell(j), the ordering of ExpressionValue
+static bool batchLess(const SqlBatchVector & a, size_t i,
+                      const SqlBatchVector & b, size_t j)
+{
+    if (a.kind == SqlBatchVector::INTEGER && b.kind == SqlBatchVector::INTEGER)
+        return a.ints[i] < b.ints[j];
+    if (a.kind == SqlBatchVector::DOUBLE && b.kind == SqlBatchVector::DOUBLE
+        && !std::isnan(a.doubles[i]) && !std::isnan(b.doubles[j]))
+        return a.doubles[i] < b.doubles[j];
+    return a.getCell(i) < b.getCell(j);
+}
+
+/// Same as a.getCell(i) == b.getCell(j)
+static bool batchEqual(const SqlBatchVector & a, size_t i,
+                       const SqlBatchVector & b, size_t j)
+{
+    if (a.kind == SqlBatchVector::INTEGER && b.kind == SqlBatchVector::INTEGER)
+        return a.ints[i] == b.ints[j];
+    if (a.kind == SqlBatchVector::DOUBLE && b.kind == SqlBatchVector::DOUBLE
+        && !std::isnan(a.doubles[i]) && !std::isnan(b.doubles[j]))
+        return a.doubles[i] == b.doubles[j];
+    return a.getCell(i) == b.getCell(j);
+}
+
+/** Row execution of a comparison whose operands are both known to be
+    stored as a Storage.  Pairs of values held that way are compared
+    directly with cmp, as in batchComparison; anything else has the same
+    result as the ExpressionValue comparison op.
+*/
+template<typename Storage, typename Cmp>
+static BoundSqlExpression::ExecFunction
+bindTypedComparison(const BoundSqlExpression & boundLhs,
+                    const BoundSqlExpression & boundRhs,
+                    bool (ExpressionValue::* op)(const ExpressionValue &) const,
+                    Cmp cmp)
+{
+    return [=] (const SqlRowScope & row, ExpressionValue & storage,
+                const VariableFilter & filter)
+        -> const ExpressionValue &
+        {
+            ExpressionValue lstorage, rstorage;
+            const ExpressionValue & l = boundLhs(row, lstorage, GET_LATEST);
+            const ExpressionValue & r = boundRhs(row, rstorage, GET_LATEST);
+            Date ts = calcTs(l, r);
+            if (l.empty() || r.empty())
+                return storage = ExpressionValue::null(ts);
+
+            Storage lv, rv;
+            if (l.isAtom() && r.isAtom()
+                && ScalarStorage<Storage>::read(l.getAtom(), lv)
+                && ScalarStorage<Storage>::read(r.getAtom(), rv))
+                return storage = ExpressionValue(cmp(lv, rv), ts);
+
+            return storage = ExpressionValue((l .* op)(r), ts);
+        };
+}
+
+template<typename Cmp>
 BoundSqlExpression
 doComparison(const SqlExpression * expr,
              const BoundSqlExpression & boundLhs,
              const BoundSqlExpression & boundRhs,
-             bool (ExpressionValue::* op)(const ExpressionValue &) const)
+             bool (ExpressionValue::* op)(const ExpressionValue &) const,
+             const Cmp & cmp)
 {
-    return {[=] (const SqlRowScope & row, ExpressionValue & storage,
-                 const VariableFilter & filter)
+    BoundSqlExpression result
+        = {[=] (const SqlRowScope & row, ExpressionValue & storage,
+                const VariableFilter & filter)
             -> const ExpressionValue &
             {
                 ExpressionValue lstorage, rstorage;
@@ -77,6 +227,33 @@ doComparison(const SqlExpression * expr,
             },
             expr,
             std::make_shared<BooleanValueInfo>(boundLhs.info->isConst() && boundRhs.info->isConst())};
+
+    if (optimizeTypedScalarOperators()) {
+        if (hasIntegerStorage(*boundLhs.info)
+            && hasIntegerStorage(*boundRhs.info)) {
+            result.exec = bindTypedComparison<int64_t>(boundLhs, boundRhs,
+                                                       op, cmp);
+        }
+        else if (hasFloatStorage(*boundLhs.info)
+                 && hasFloatStorage(*boundRhs.info)) {
+            result.exec = bindTypedComparison<double>(boundLhs, boundRhs,
+                                                      op, cmp);
+        }
+    }
+
+    if (isBatchable(boundLhs) && isBatchable(boundRhs)) {
+        result.batchExec = [=] (const SqlBatch & batch,
+                                const SqlSelection & selection,
+                                SqlBatchVector & out)
+            {
+                SqlBatchVector l, r;
+                evalBatch(boundLhs, batch, selection, l);
+                evalBatch(boundRhs, batch, selection, r);
+                batchComparison(l, r, op, cmp, out);
+            };
+    }
+
+    return result;
 }
 
 BoundSqlExpression
@@ -88,27 +265,33 @@ bind(SqlBindingScope & scope) const
 
     if (op == "=" || op == "==") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator ==);
+                            &ExpressionValue::operator ==,
+                            std::equal_to<>());
     }
     else if (op == "!=") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator !=);
+                            &ExpressionValue::operator !=,
+                            std::not_equal_to<>());
     }
     else if (op == ">") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator > );
+                            &ExpressionValue::operator >,
+                            std::greater<>());
     }
     else if (op == "<") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator < );
+                            &ExpressionValue::operator <,
+                            std::less<>());
     }
     else if (op == ">=") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator >=);
+                            &ExpressionValue::operator >=,
+                            std::greater_equal<>());
     }
     else if (op == "<=") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator <=);
+                            &ExpressionValue::operator <=,
+                            std::less_equal<>());
     }
     else throw AnnotatedException(400, "Unknown comparison op " + op);
 }
@@ -1174,6 +1357,50 @@ static CellValue binaryModulus(const CellValue & la, const CellValue & ra)
     else return fmod(la.toDouble(), ra.toDouble());
 }
 
+/** Apply a binary arithmetic operator to the values of two batch vectors
+    one pair of atoms at a time with Op::apply.
+*/
+template<typename Op>
+static void
+batchApplyCells(const SqlBatchVector & l,
+                const SqlBatchVector & r,
+                SqlBatchVector & out)
+{
+    size_t n = l.size();
+    std::vector<CellValue> values(n);
+    for (size_t i = 0;  i < n;  ++i) {
+        values[i] = Op::apply(l.getCell(i), r.getCell(i));
+    }
+    out.initCells(std::move(values));
+}
+
+/** Apply a binary arithmetic operator to the values of two batch vectors,
+    with the same result as Op::apply.  In row mode, arithmetic on two
+    numbers is done on doubles, so pairs of numbers are combined directly
+    with fn; anything else goes through Op::apply.
+*/
+template<typename Op, typename Fn>
+static void
+batchArithmetic(const SqlBatchVector & l,
+                const SqlBatchVector & r,
+                SqlBatchVector & out,
+                const Fn & fn)
+{
+    size_t n = l.size();
+
+    if (l.isNumeric() && r.isNumeric()) {
+        out.initDoubles(n);
+        for (size_t i = 0;  i < n;  ++i) {
+            if (l.isNull(i) || r.isNull(i))
+                out.setNull(i);
+            else out.doubles[i] = fn(l.getDouble(i), r.getDouble(i));
+        }
+        return;
+    }
+
+    batchApplyCells<Op>(l, r, out);
+}
+
 struct BinaryPlusOp {
     static CellValue apply(const CellValue & l, const CellValue & r)
     {
@@ -1183,6 +1410,13 @@ struct BinaryPlusOp {
         return binaryPlus(l, r);
     }
 
+    static void applyBatch(const SqlBatchVector & l, const SqlBatchVector & r,
+                           SqlBatchVector & out)
+    {
+        batchArithmetic<BinaryPlusOp>(l, r, out, [] (double x, double y)
+                                      { return x + y; });
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1200,6 +1434,13 @@ struct BinaryMinusOp {
         return binaryMinus(l, r);
     }
 
+    static void applyBatch(const SqlBatchVector & l, const SqlBatchVector & r,
+                           SqlBatchVector & out)
+    {
+        batchArithmetic<BinaryMinusOp>(l, r, out, [] (double x, double y)
+                                       { return x - y; });
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1217,6 +1458,13 @@ struct BinaryMultiplicationOp {
         return binaryMultiplication(l, r);
     }
 
+    static void applyBatch(const SqlBatchVector & l, const SqlBatchVector & r,
+                           SqlBatchVector & out)
+    {
+        batchArithmetic<BinaryMultiplicationOp>
+            (l, r, out, [] (double x, double y) { return x * y; });
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1234,6 +1482,13 @@ struct BinaryDivisionOp {
         return binaryDivision(l, r);
     }
 
+    static void applyBatch(const SqlBatchVector & l, const SqlBatchVector & r,
+                           SqlBatchVector & out)
+    {
+        batchArithmetic<BinaryDivisionOp>
+            (l, r, out, [] (double x, double y) { return x / y; });
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1251,6 +1506,30 @@ struct BinaryModulusOp {
         return binaryModulus(l, r);
     }
 
+    static void applyBatch(const SqlBatchVector & l, const SqlBatchVector & r,
+                           SqlBatchVector & out)
+    {
+        if (l.kind == SqlBatchVector::INTEGER
+            && r.kind == SqlBatchVector::INTEGER) {
+            size_t n = l.size();
+            out.initIntegers(n);
+            for (size_t i = 0;  i < n;  ++i) {
+                if (l.isNull(i) || r.isNull(i))
+                    out.setNull(i);
+                // Row mode treats a non-negative integer as unsigned, so a
+                // pair with different signs needs to go through it
+                else if ((l.ints[i] < 0) != (r.ints[i] < 0))
+                    out.ints[i] = binaryModulus(l.ints[i], r.ints[i]).toInt();
+                else out.ints[i] = safeIntegerMod<int64_t, int64_t>
+                         (l.ints[i], r.ints[i]).toInt();
+            }
+            return;
+        }
+        // A double may be integral, which makes it an integer in row mode,
+        // so anything else is done one value at a time
+        batchApplyCells<BinaryModulusOp>(l, r, out);
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1259,6 +1538,122 @@ struct BinaryModulusOp {
     }
 };
 
+/** Add a batchExec function to the result of binding a binary arithmetic
+    operator, when both of its operands are atoms.
+*/
+template<typename Op>
+static BoundSqlExpression
+addBatchArithmetic(BoundSqlExpression result,
+                   const BoundSqlExpression & boundLhs,
+                   const BoundSqlExpression & boundRhs)
+{
+    if (isBatchable(boundLhs) && isBatchable(boundRhs)) {
+        result.batchExec = [=] (const SqlBatch & batch,
+                                const SqlSelection & selection,
+                                SqlBatchVector & out)
+            {
+                SqlBatchVector l, r;
+                evalBatch(boundLhs, batch, selection, l);
+                evalBatch(boundRhs, batch, selection, r);
+                Op::applyBatch(l, r, out);
+            };
+    }
+    return result;
+}
+
+/** Row execution of a binary arithmetic operator on two scalars, where
+    pairs of values that Read can read are combined directly with fn and
+    anything else goes through Op::apply.
+*/
+template<typename Op, typename Storage, typename Read, typename Fn>
+static BoundSqlExpression::ExecFunction
+bindTypedArithmetic(const BoundSqlExpression & boundLhs,
+                    const BoundSqlExpression & boundRhs,
+                    Read read, Fn fn)
+{
+    return [=] (const SqlRowScope & row, ExpressionValue & storage,
+                const VariableFilter & filter)
+        -> const ExpressionValue &
+        {
+            ExpressionValue lstorage, rstorage;
+            const ExpressionValue & l = boundLhs(row, lstorage, GET_LATEST);
+            const ExpressionValue & r = boundRhs(row, rstorage, GET_LATEST);
+            Date ts = calcTs(l, r);
+
+            Storage lv, rv;
+            if (read(l.getAtom(), lv) && read(r.getAtom(), rv))
+                return storage = ExpressionValue(fn(lv, rv), ts);
+
+            return storage = ExpressionValue(Op::apply(l.getAtom(),
+                                                       r.getAtom()),
+                                             ts);
+        };
+}
+
+/// Read any number as a double, which is how +, -, * and / work on them
+static bool readAsDouble(const CellValue & v, double & out)
+{
+    if (v.isDouble()) {
+        out = v.toDouble();
+        return true;
+    }
+    if (!v.isInteger())
+        return false;
+    out = v.isUnsignedInteger() ? (double)v.toUInt() : (double)v.toInt();
+    return true;
+}
+
+/** Specialize the row execution of a binary arithmetic operator that has
+    been bound by BinaryOpHelper when both of its operands are numbers of
+    a known storage.  Numbers are combined with fn on doubles, which is
+    what Op::apply does for them once it's checked they aren't strings,
+    timestamps or intervals.
+*/
+template<typename Op, typename Fn>
+static BoundSqlExpression
+addTypedArithmetic(BoundSqlExpression result,
+                   const BoundSqlExpression & boundLhs,
+                   const BoundSqlExpression & boundRhs,
+                   Fn fn)
+{
+    auto isNumber = [] (const ExpressionValueInfo & info)
+        {
+            return hasIntegerStorage(info) || hasFloatStorage(info);
+        };
+
+    if (optimizeTypedScalarOperators()
+        && isNumber(*boundLhs.info) && isNumber(*boundRhs.info)) {
+        result.exec = bindTypedArithmetic<Op, double>
+            (boundLhs, boundRhs, &readAsDouble,
+             [=] (double l, double r) { return CellValue(fn(l, r)); });
+    }
+    return result;
+}
+
+/** Same for the modulus, which only has a direct implementation for two
+    integers of the same sign.  Op::apply treats a non-negative integer as
+    unsigned, so a pair with different signs goes through it.
+*/
+static BoundSqlExpression
+addTypedModulus(BoundSqlExpression result,
+                const BoundSqlExpression & boundLhs,
+                const BoundSqlExpression & boundRhs)
+{
+    if (optimizeTypedScalarOperators()
+        && hasIntegerStorage(*boundLhs.info)
+        && hasIntegerStorage(*boundRhs.info)) {
+        result.exec = bindTypedArithmetic<BinaryModulusOp, int64_t>
+            (boundLhs, boundRhs, &ScalarStorage<int64_t>::read,
+             [] (int64_t l, int64_t r)
+             {
+                 if ((l < 0) != (r < 0))
+                     return binaryModulus(l, r);
+                 return safeIntegerMod<int64_t, int64_t>(l, r);
+             });
+    }
+    return result;
+}
+
 BoundSqlExpression
 ArithmeticExpression::
 bind(SqlBindingScope & scope) const
@@ -1267,25 +1662,74 @@ bind(SqlBindingScope & scope) const
     auto boundRhs = rhs->bind(scope);
 
     if (op == "+" && lhs) {
-        return BinaryOpHelper<BinaryPlusOp>::bind(this, boundLhs, boundRhs);
+        auto result = addTypedArithmetic<BinaryPlusOp>
+            (BinaryOpHelper<BinaryPlusOp>::bind(this, boundLhs, boundRhs),
+             boundLhs, boundRhs, [] (double x, double y) { return x + y; });
+        return addBatchArithmetic<BinaryPlusOp>(std::move(result),
+                                                boundLhs, boundRhs);
     }
     else if (op == "-" && lhs) {
-        return BinaryOpHelper<BinaryMinusOp>::bind(this, boundLhs, boundRhs);
+        auto result = addTypedArithmetic<BinaryMinusOp>
+            (BinaryOpHelper<BinaryMinusOp>::bind(this, boundLhs, boundRhs),
+             boundLhs, boundRhs, [] (double x, double y) { return x - y; });
+        return addBatchArithmetic<BinaryMinusOp>(std::move(result),
+                                                 boundLhs, boundRhs);
     }
     else if (op == "-" && !lhs) {
-        return doUnaryArithmetic<AtomValueInfo>(this, boundRhs, &unaryMinus);
+        auto result = doUnaryArithmetic<AtomValueInfo>(this, boundRhs,
+                                                       &unaryMinus);
+        if (isBatchable(boundRhs)) {
+            result.batchExec = [=] (const SqlBatch & batch,
+                                    const SqlSelection & selection,
+                                    SqlBatchVector & out)
+                {
+                    SqlBatchVector r;
+                    evalBatch(boundRhs, batch, selection, r);
+                    size_t n = r.size();
+                    if (r.kind == SqlBatchVector::INTEGER) {
+                        out = std::move(r);
+                        for (auto & v: out.ints)
+                            v = -v;
+                    }
+                    else if (r.kind == SqlBatchVector::DOUBLE) {
+                        out = std::move(r);
+                        for (auto & v: out.doubles)
+                            v = -v;
+                    }
+                    else {
+                        std::vector<CellValue> values(n);
+                        for (size_t i = 0;  i < n;  ++i) {
+                            if (!r.atoms[i].empty())
+                                values[i] = unaryMinus(r.atoms[i]);
+                        }
+                        out.initCells(std::move(values));
+                    }
+                };
+        }
+        return result;
     }
     else if (op == "*" && lhs) {
-        return BinaryOpHelper<BinaryMultiplicationOp>
-            ::bind(this, boundLhs, boundRhs);
+        auto result = addTypedArithmetic<BinaryMultiplicationOp>
+            (BinaryOpHelper<BinaryMultiplicationOp>
+             ::bind(this, boundLhs, boundRhs),
+             boundLhs, boundRhs, [] (double x, double y) { return x * y; });
+        return addBatchArithmetic<BinaryMultiplicationOp>
+            (std::move(result), boundLhs, boundRhs);
     }
     else if (op == "/" && lhs) {
-        return BinaryOpHelper<BinaryDivisionOp>
-            ::bind(this, boundLhs, boundRhs);
+        auto result = addTypedArithmetic<BinaryDivisionOp>
+            (BinaryOpHelper<BinaryDivisionOp>
+             ::bind(this, boundLhs, boundRhs),
+             boundLhs, boundRhs, [] (double x, double y) { return x / y; });
+        return addBatchArithmetic<BinaryDivisionOp>
+            (std::move(result), boundLhs, boundRhs);
     }
     else if (op == "%" && lhs) {
-        return BinaryOpHelper<BinaryModulusOp>
-            ::bind(this, boundLhs, boundRhs);
+        return addBatchArithmetic<BinaryModulusOp>
+            (addTypedModulus(BinaryOpHelper<BinaryModulusOp>
+                             ::bind(this, boundLhs, boundRhs),
+                             boundLhs, boundRhs),
+             boundLhs, boundRhs);
     }
     else throw AnnotatedException(400, "Unknown arithmetic op " + op
                                    + (lhs ? " binary" : " unary"));
@@ -1529,15 +1973,34 @@ bind(SqlBindingScope & scope) const
     //evaluate them, even if it always returns the same value.
     auto info = getVariable.info->getConst(false);
 
-    return {[=] (const SqlRowScope & row,
-                 ExpressionValue & storage,
-                 const VariableFilter & filter) -> const ExpressionValue &
+    BoundSqlExpression result
+        = {[=] (const SqlRowScope & row,
+                ExpressionValue & storage,
+                const VariableFilter & filter) -> const ExpressionValue &
             {
                 // TODO: allow it access to storage
                 return getVariable(row, storage, filter);
             },
             this,
             info};
+
+    BatchColumnGetter getBatch;
+    if (isBatchable(result))
+        getBatch = scope.doGetColumnBatch("" /*tableName*/, columnName);
+
+    if (getBatch) {
+        // Columns that the batch can't read are read a row at a time
+        BoundSqlExpression rowMode = result;
+        result.batchExec = [=] (const SqlBatch & batch,
+                                const SqlSelection & selection,
+                                SqlBatchVector & out)
+            {
+                if (!getBatch(batch, selection, out))
+                    evalBatch(rowMode, batch, selection, out);
+            };
+    }
+
+    return result;
 }
 
 Utf8String
@@ -1605,14 +2068,20 @@ bind(SqlBindingScope & scope) const
 {
     ExpressionValue val = constant;
 
-    return {[=] (const SqlRowScope &,
-                 ExpressionValue & storage,
-                 const VariableFilter & filter) -> const ExpressionValue &
+    BoundSqlExpression result
+        = {[=] (const SqlRowScope &,
+                ExpressionValue & storage,
+                const VariableFilter & filter) -> const ExpressionValue &
             {
                 return storage=val;
             },
             this,
             constant.getSpecializedValueInfo(true /* is constant */)};
+
+    if (constant.isAtom())
+        result.batchExec = batchConstant(constant.getAtom());
+
+    return result;
 }
 
 Utf8String
@@ -1963,6 +2432,12 @@ bind(SqlBindingScope & scope) const
                 this,
                 std::make_shared<BooleanValueInfo>(true)};
 
+    constFalse.batchExec = batchConstant(false);
+    constTrue.batchExec = batchConstant(true);
+    constNull.batchExec = batchConstant(CellValue());
+
+    bool batchable = isBatchable(boundRhs) && (!lhs || isBatchable(boundLhs));
+
     if (op == "AND" && lhs) {
 
         if ((boundLhs.info->isConst() && boundLhs.constantValue().isFalse())
@@ -1977,9 +2452,10 @@ bind(SqlBindingScope & scope) const
 
         bool constant = (boundLhs.info->isConst() && boundRhs.info->isConst());
 
-        return {[=] (const SqlRowScope & row,
-                     ExpressionValue & storage,
-                     const VariableFilter & filter) -> const ExpressionValue &
+        BoundSqlExpression result
+            = {[=] (const SqlRowScope & row,
+                    ExpressionValue & storage,
+                    const VariableFilter & filter) -> const ExpressionValue &
                 {
                     ExpressionValue lstorage, rstorage;
                     const ExpressionValue & l = boundLhs(row, lstorage, filter);
@@ -2010,6 +2486,28 @@ bind(SqlBindingScope & scope) const
                 },
                 this,
                 std::make_shared<BooleanValueInfo>(constant)};
+
+        if (batchable) {
+            result.batchExec = [=] (const SqlBatch & batch,
+                                    const SqlSelection & selection,
+                                    SqlBatchVector & out)
+                {
+                    SqlBatchVector l, r;
+                    evalBatch(boundLhs, batch, selection, l);
+                    evalBatch(boundRhs, batch, selection, r);
+                    size_t n = l.size();
+                    out.initIntegers(n);
+                    for (size_t i = 0;  i < n;  ++i) {
+                        if (l.isFalse(i) || r.isFalse(i))
+                            out.ints[i] = false;
+                        else if (l.isNull(i) || r.isNull(i))
+                            out.setNull(i);
+                        else out.ints[i] = true;
+                    }
+                };
+        }
+
+        return result;
     }
     else if (op == "OR" && lhs) {
 
@@ -2026,9 +2524,10 @@ bind(SqlBindingScope & scope) const
 
         bool constant = (boundLhs.info->isConst() && boundRhs.info->isConst());
 
-        return {[=] (const SqlRowScope & row,
-                     ExpressionValue & storage,
-                     const VariableFilter & filter)
+        BoundSqlExpression result
+            = {[=] (const SqlRowScope & row,
+                    ExpressionValue & storage,
+                    const VariableFilter & filter)
                 -> const ExpressionValue &
                 {
                     ExpressionValue lstorage, rstorage;
@@ -2062,12 +2561,35 @@ bind(SqlBindingScope & scope) const
                 },
                 this,
                 std::make_shared<BooleanValueInfo>(constant)};
+
+        if (batchable) {
+            result.batchExec = [=] (const SqlBatch & batch,
+                                    const SqlSelection & selection,
+                                    SqlBatchVector & out)
+                {
+                    SqlBatchVector l, r;
+                    evalBatch(boundLhs, batch, selection, l);
+                    evalBatch(boundRhs, batch, selection, r);
+                    size_t n = l.size();
+                    out.initIntegers(n);
+                    for (size_t i = 0;  i < n;  ++i) {
+                        if (l.isTrue(i) || r.isTrue(i))
+                            out.ints[i] = true;
+                        else if (l.isNull(i) || r.isNull(i))
+                            out.setNull(i);
+                        else out.ints[i] = false;
+                    }
+                };
+        }
+
+        return result;
     }
     else if (op == "NOT" && !lhs) {
 
-        return {[=] (const SqlRowScope & row,
-                     ExpressionValue & storage,
-                     const VariableFilter & filter)
+        BoundSqlExpression result
+            = {[=] (const SqlRowScope & row,
+                    ExpressionValue & storage,
+                    const VariableFilter & filter)
                 -> const ExpressionValue &
                 {
                     ExpressionValue rstorage;
@@ -2078,6 +2600,25 @@ bind(SqlBindingScope & scope) const
                 },
                 this,
                 std::make_shared<BooleanValueInfo>(boundRhs.info->isConst())};
+
+        if (batchable) {
+            result.batchExec = [=] (const SqlBatch & batch,
+                                    const SqlSelection & selection,
+                                    SqlBatchVector & out)
+                {
+                    SqlBatchVector r;
+                    evalBatch(boundRhs, batch, selection, r);
+                    size_t n = r.size();
+                    out.initIntegers(n);
+                    for (size_t i = 0;  i < n;  ++i) {
+                        if (r.isNull(i))
+                            out.setNull(i);
+                        else out.ints[i] = !r.isTrue(i);
+                    }
+                };
+        }
+
+        return result;
     }
     else throw AnnotatedException(400, "Unknown boolean op " + op
                              + (lhs ? " binary" : " unary"));
@@ -2187,9 +2728,10 @@ bind(SqlBindingScope & scope) const
     }
     else throw AnnotatedException(400, "Unknown type `" + type + "' for IsTypeExpression");
 
-    return {[=] (const SqlRowScope & row,
-                 ExpressionValue & storage,
-                 const VariableFilter & filter) -> const ExpressionValue &
+    BoundSqlExpression result
+        = {[=] (const SqlRowScope & row,
+                ExpressionValue & storage,
+                const VariableFilter & filter) -> const ExpressionValue &
             {
                 auto v = boundExpr(row, filter);
                 bool val = (v .* fn) ();
@@ -2198,6 +2740,32 @@ bind(SqlBindingScope & scope) const
             },
             this,
             std::make_shared<BooleanValueInfo>(boundExpr.info->isConst())};
+
+    if (isBatchable(boundExpr)) {
+        bool isNull = type == "null";
+        result.batchExec = [=] (const SqlBatch & batch,
+                                const SqlSelection & selection,
+                                SqlBatchVector & out)
+            {
+                SqlBatchVector v;
+                evalBatch(boundExpr, batch, selection, v);
+                size_t n = v.size();
+                out.initIntegers(n);
+                for (size_t i = 0;  i < n;  ++i) {
+                    bool val;
+                    if (isNull)
+                        val = v.isNull(i);
+                    else {
+                        ExpressionValue ev(v.getCell(i),
+                                           Date::negativeInfinity());
+                        val = (ev .* fn) ();
+                    }
+                    out.ints[i] = notType ? !val : val;
+                }
+            };
+    }
+
+    return result;
 }
 
 Utf8String
@@ -2361,9 +2929,10 @@ bindBuiltinFunction(SqlBindingScope & scope,
         };
     }
     else {
-        return {[=] (const SqlRowScope & row,
-                     ExpressionValue & storage,
-                     const VariableFilter & filter) -> const ExpressionValue &
+        BoundSqlExpression result
+            = {[=] (const SqlRowScope & row,
+                    ExpressionValue & storage,
+                    const VariableFilter & filter) -> const ExpressionValue &
                 {
                     std::vector<ExpressionValue> evaluatedArgs;
                     evaluatedArgs.reserve(boundArgs.size());
@@ -2375,6 +2944,71 @@ bindBuiltinFunction(SqlBindingScope & scope,
                 this,
                 fn.resultInfo
         };
+
+        if (fn.extractColumn) {
+            auto extractColumn = fn.extractColumn;
+            result.extractColumn = [=] (const SqlRowScope & row,
+                                        const ColumnPath & column,
+                                        const VariableFilter & filter)
+                {
+                    std::vector<ExpressionValue> evaluatedArgs;
+                    evaluatedArgs.reserve(boundArgs.size());
+                    for (auto & a: boundArgs)
+                        evaluatedArgs.emplace_back(a(row, fn.filter));
+
+                    return extractColumn(evaluatedArgs, column, filter);
+                };
+        }
+
+        // Identical calls to a deterministic function within the scope
+        // are calculated once per row, and the later ones take a copy of
+        // the first.  Constant calls are already folded so don't need it.
+        int slot = -1;
+        if (fn.deterministic && !result.info->isConst())
+            slot = scope.getSharedSubexpressionSlot(print());
+
+        if (slot != -1) {
+            auto exec = std::move(result.exec);
+            std::shared_ptr<const SharedSubexpressions> shared
+                = scope.sharedSubexpressions;
+            result.exec = [=] (const SqlRowScope & row,
+                               ExpressionValue & storage,
+                               const VariableFilter & filter)
+                -> const ExpressionValue &
+                {
+                    SharedSubexpressionValues * values
+                        = row.getSharedSubexpressions();
+                    if (!values || !values->claim(shared.get()))
+                        return exec(row, storage, filter);
+
+                    if (auto * value = values->find(slot))
+                        return storage = *value;
+
+                    const ExpressionValue & value = exec(row, storage, filter);
+                    values->insert(slot, value);
+                    return value;
+                };
+        }
+
+        bool batchable = !!fn.batchExec;
+        for (auto & a: boundArgs)
+            batchable = batchable && isBatchable(a);
+
+        if (batchable) {
+            auto batchFn = fn.batchExec;
+            result.batchExec = [=] (const SqlBatch & batch,
+                                    const SqlSelection & selection,
+                                    SqlBatchVector & out)
+                {
+                    std::vector<SqlBatchVector> evaluatedArgs(boundArgs.size());
+                    for (size_t i = 0;  i < boundArgs.size();  ++i)
+                        evalBatch(boundArgs[i], batch, selection,
+                                  evaluatedArgs[i]);
+                    batchFn(evaluatedArgs, out);
+                };
+        }
+
+        return result;
     }
 }
 
@@ -2514,6 +3148,23 @@ bind(SqlBindingScope & outerScope) const
 
     auto outputInfo = extractBound.info->getConst(isConst);
 
+    // Reading a single column of a value that can give one column without
+    // being built in full (eg, parse_json) doesn't build the rest of it
+    auto readColumn
+        = std::dynamic_pointer_cast<const ReadColumnExpression>(extract);
+    if (readColumn && fromBound.extractColumn && !isConst) {
+        auto extractColumn = fromBound.extractColumn;
+        ColumnPath column = readColumn->columnName;
+        return {[=] (const SqlRowScope & row,
+                     ExpressionValue & storage,
+                     const VariableFilter & filter) -> const ExpressionValue &
+                {
+                    return storage = extractColumn(row, column, filter);
+                },
+                this,
+                outputInfo};
+    }
+
     return {[=] (const SqlRowScope & row,
                  ExpressionValue & storage,
                  const VariableFilter & filter) -> const ExpressionValue &
@@ -2605,6 +3256,72 @@ functionNames() const
 /* CASE EXPRESSION                                                           */
 /*****************************************************************************/
 
+/** Gathers the output of a CASE expression executed in batch mode, where
+    each branch is executed for a subset of the rows.
+*/
+struct BatchCaseOutput {
+    BatchCaseOutput(const SqlSelection & selection, SqlBatchVector & out)
+        : selection(selection), out(out), done(selection.size())
+    {
+    }
+
+    const SqlSelection & selection;
+    SqlBatchVector & out;
+    bool initialized = false;
+    std::vector<uint8_t> done;
+
+    /// Return the rows of the batch at the given positions of selection
+    SqlSelection select(const std::vector<uint32_t> & positions) const
+    {
+        SqlSelection result(positions.size());
+        for (size_t i = 0;  i < positions.size();  ++i)
+            result[i] = selection[positions[i]];
+        return result;
+    }
+
+    /// Execute expr for the given positions of selection, which it outputs
+    void add(const BoundSqlExpression & expr,
+             const SqlBatch & batch,
+             const std::vector<uint32_t> & positions)
+    {
+        if (positions.empty())
+            return;
+
+        SqlBatchVector values;
+        evalBatch(expr, batch, select(positions), values);
+
+        if (!initialized) {
+            // Take the kind of the first branch; the others are converted
+            // if they are different
+            size_t n = selection.size();
+            switch (values.kind) {
+            case SqlBatchVector::INTEGER:  out.initIntegers(n);  break;
+            case SqlBatchVector::DOUBLE:   out.initDoubles(n);  break;
+            case SqlBatchVector::ATOM:     out.initAtoms(n);  break;
+            }
+            initialized = true;
+        }
+
+        for (size_t i = 0;  i < positions.size();  ++i) {
+            out.set(positions[i], values, i);
+            done[positions[i]] = true;
+        }
+    }
+
+    /// Set the rows that no branch output to null
+    void finish()
+    {
+        if (!initialized) {
+            out.initAtoms(selection.size());
+            return;
+        }
+        for (size_t i = 0;  i < done.size();  ++i) {
+            if (!done[i])
+                out.setNull(i);
+        }
+    }
+};
+
 CaseExpression::
 CaseExpression(std::shared_ptr<SqlExpression> expr,
                std::vector<std::pair<std::shared_ptr<SqlExpression>,
@@ -2643,6 +3360,14 @@ bind(SqlBindingScope & scope) const
         isConst = isConst && boundWhen.back().second.info->isConst();
     }
 
+    // Each branch is executed in batch mode only for the rows that take
+    // it, so that it's not executed for rows that row mode wouldn't
+    bool batchable = !elseExpr || isBatchable(boundElse);
+    for (auto & w: boundWhen) {
+        batchable = batchable && isBatchable(w.first)
+            && isBatchable(w.second);
+    }
+
     if (expr) {
         // Simple CASE expression
 
@@ -2651,9 +3376,10 @@ bind(SqlBindingScope & scope) const
 
         auto outputInfo = info->getConst(isConst);
 
-        return {[=] (const SqlRowScope & row,
-                     ExpressionValue & storage,
-                     const VariableFilter & filter)
+        BoundSqlExpression result
+            = {[=] (const SqlRowScope & row,
+                    ExpressionValue & storage,
+                    const VariableFilter & filter)
                     -> const ExpressionValue &
                 {
                     ExpressionValue vstorage;
@@ -2685,15 +3411,62 @@ bind(SqlBindingScope & scope) const
                 },
                 this,
                 outputInfo};
+
+        if (batchable && isBatchable(boundExpr)) {
+            result.batchExec = [=] (const SqlBatch & batch,
+                                    const SqlSelection & selection,
+                                    SqlBatchVector & out)
+                {
+                    SqlBatchVector v;
+                    evalBatch(boundExpr, batch, selection, v);
+
+                    // Positions within selection that haven't matched yet
+                    std::vector<uint32_t> remaining;
+                    std::vector<uint32_t> unmatched;
+                    for (size_t i = 0;  i < selection.size();  ++i) {
+                        if (v.isNull(i))
+                            unmatched.push_back(i);
+                        else remaining.push_back(i);
+                    }
+
+                    BatchCaseOutput output(selection, out);
+
+                    for (auto & w: boundWhen) {
+                        if (remaining.empty())
+                            break;
+                        SqlBatchVector wv;
+                        evalBatch(w.first, batch,
+                                  output.select(remaining), wv);
+                        std::vector<uint32_t> matched, notMatched;
+                        for (size_t i = 0;  i < remaining.size();  ++i) {
+                            if (!wv.isNull(i)
+                                && batchEqual(wv, i, v, remaining[i]))
+                                matched.push_back(remaining[i]);
+                            else notMatched.push_back(remaining[i]);
+                        }
+                        output.add(w.second, batch, matched);
+                        remaining = std::move(notMatched);
+                    }
+
+                    unmatched.insert(unmatched.end(),
+                                     remaining.begin(), remaining.end());
+                    if (elseExpr)
+                        output.add(boundElse, batch, unmatched);
+                    output.finish();
+                };
+        }
+
+        return result;
     }
     else {
         // Searched CASE expression
 
         auto outputInfo = info->getConst(isConst);
 
-        return {[=] (const SqlRowScope & row,
-                     ExpressionValue & storage,
-                     const VariableFilter & filter)
+        BoundSqlExpression result
+            = {[=] (const SqlRowScope & row,
+                    ExpressionValue & storage,
+                    const VariableFilter & filter)
                     -> const ExpressionValue &
                 {
                     for (auto & w: boundWhen) {
@@ -2709,6 +3482,42 @@ bind(SqlBindingScope & scope) const
                 },
                 this,
                 outputInfo};
+
+        if (batchable) {
+            result.batchExec = [=] (const SqlBatch & batch,
+                                    const SqlSelection & selection,
+                                    SqlBatchVector & out)
+                {
+                    // Positions within selection that haven't matched yet
+                    std::vector<uint32_t> remaining(selection.size());
+                    for (size_t i = 0;  i < selection.size();  ++i)
+                        remaining[i] = i;
+
+                    BatchCaseOutput output(selection, out);
+
+                    for (auto & w: boundWhen) {
+                        if (remaining.empty())
+                            break;
+                        SqlBatchVector c;
+                        evalBatch(w.first, batch,
+                                  output.select(remaining), c);
+                        std::vector<uint32_t> matched, notMatched;
+                        for (size_t i = 0;  i < remaining.size();  ++i) {
+                            if (c.isTrue(i))
+                                matched.push_back(remaining[i]);
+                            else notMatched.push_back(remaining[i]);
+                        }
+                        output.add(w.second, batch, matched);
+                        remaining = std::move(notMatched);
+                    }
+
+                    if (elseExpr)
+                        output.add(boundElse, batch, remaining);
+                    output.finish();
+                };
+        }
+
+        return result;
     }
 }
 
@@ -2812,9 +3621,10 @@ bind(SqlBindingScope & scope) const
     BoundSqlExpression boundUpper = upper->bind(scope);
     bool isConstant = boundExpr.info->isConst() && boundLower.info->isConst() && boundUpper.info->isConst();
 
-    return {[=] (const SqlRowScope & row,
-                 ExpressionValue & storage,
-                 const VariableFilter & filter) -> const ExpressionValue &
+    BoundSqlExpression result
+        = {[=] (const SqlRowScope & row,
+                ExpressionValue & storage,
+                const VariableFilter & filter) -> const ExpressionValue &
             {
                 ExpressionValue vstorage, lstorage, ustorage;
 
@@ -2846,6 +3656,34 @@ bind(SqlBindingScope & scope) const
             },
             this,
             std::make_shared<BooleanValueInfo>(isConstant)};
+
+    if (isBatchable(boundExpr) && isBatchable(boundLower)
+        && isBatchable(boundUpper)) {
+        result.batchExec = [=] (const SqlBatch & batch,
+                                const SqlSelection & selection,
+                                SqlBatchVector & out)
+            {
+                SqlBatchVector v, l, u;
+                evalBatch(boundExpr, batch, selection, v);
+                evalBatch(boundLower, batch, selection, l);
+                evalBatch(boundUpper, batch, selection, u);
+                size_t n = v.size();
+                out.initIntegers(n);
+                for (size_t i = 0;  i < n;  ++i) {
+                    if (v.isNull(i) || l.isNull(i))
+                        out.setNull(i);
+                    else if (batchLess(v, i, l, i))
+                        out.ints[i] = notBetween;
+                    else if (u.isNull(i))
+                        out.setNull(i);
+                    else if (batchLess(u, i, v, i))
+                        out.ints[i] = notBetween;
+                    else out.ints[i] = !notBetween;
+                }
+            };
+    }
+
+    return result;
 }
 
 Utf8String
@@ -0,0 +1,113 @@
+/* json_extract_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Tests for the extraction of a single column of a JSON document.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/sql/json_extract.h"
+#include "mldb/types/json_parsing.h"
+#include "mldb/arch/exception_handler.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+static ExpressionValue parseFull(const std::string & json,
+                                 const ColumnPath & column,
+                                 Date ts)
+{
+    StreamingJsonParsingContext parser("test", json.c_str(), json.size());
+    return ExpressionValue::parseJson(parser, ts, PARSE_ARRAYS)
+        .getNestedColumn(column, GET_LATEST);
+}
+
+BOOST_AUTO_TEST_CASE( test_same_as_full_parse )
+{
+    Date ts = Date::fromSecondsSinceEpoch(1000);
+
+    std::vector<std::string> docs = {
+        "{}",
+        "{\"user\": {\"id\": 12, \"name\": \"bob\"}, \"x\": [1, 2, {\"y\": null}]}",
+        " { \"x\" : 1.5e3 , \"user\" : { \"tags\" : [\"a\", \"b\"] } } ",
+        "{\"user\": \"not an object\", \"z\": true}",
+        "{\"user\": {\"id\": {\"deep\": [false]}}, \"s\": \"\\\"quoted\\\"\"}",
+        "{\"x\": {\"user\": {\"id\": 3}}}"
+    };
+
+    std::vector<ColumnPath> columns = {
+        ColumnPath::parse("user"),
+        ColumnPath::parse("user.id"),
+        ColumnPath::parse("user.id.deep"),
+        ColumnPath::parse("user.tags"),
+        ColumnPath::parse("user.missing"),
+        ColumnPath::parse("x"),
+        ColumnPath::parse("x.1"),
+        ColumnPath::parse("s"),
+        ColumnPath::parse("nothing")
+    };
+
+    for (auto & doc: docs) {
+        for (auto & column: columns) {
+            BOOST_TEST_CONTEXT(doc << " " << column) {
+                ExpressionValue result;
+                BOOST_REQUIRE(tryExtractJsonColumn(doc.c_str(), doc.size(),
+                                                   column, ts, GET_LATEST,
+                                                   result));
+                ExpressionValue expected = parseFull(doc, column, ts);
+                BOOST_CHECK_EQUAL(result, expected);
+                BOOST_CHECK_EQUAL(result.getEffectiveTimestamp(),
+                                  expected.getEffectiveTimestamp());
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_needs_full_parse )
+{
+    Date ts = Date::fromSecondsSinceEpoch(1000);
+    ColumnPath column = ColumnPath::parse("user.id");
+
+    std::vector<std::string> docs = {
+        // Not an object
+        "[1, 2]",
+        "\"user\"",
+        // Malformed, including after the column
+        "{\"user\": {\"id\": 1}",
+        "{\"user\": {\"id\": 1}, \"x\": [1,]}",
+        "{\"user\": {\"id\": 1}} trailing",
+        "{\"x\": 01, \"user\": {\"id\": 1}}",
+        // Escaped key, or the same key twice, on the path
+        "{\"us\\u0065r\": {\"id\": 1}}",
+        "{\"user\": {\"id\": 1}, \"user\": {\"id\": 2}}",
+        "{\"user\": {\"id\": 1, \"id\": 2}}"
+    };
+
+    for (auto & doc: docs) {
+        BOOST_TEST_CONTEXT(doc) {
+            ExpressionValue result;
+            BOOST_CHECK(!tryExtractJsonColumn(doc.c_str(), doc.size(),
+                                              column, ts, GET_LATEST,
+                                              result));
+        }
+    }
+
+    // Escapes and duplicates off the path don't matter
+    std::string doc = "{\"a\\u0062\": 1, \"x\": 1, \"x\": 2, \"user\": {\"id\": 3}}";
+    ExpressionValue result;
+    BOOST_REQUIRE(tryExtractJsonColumn(doc.c_str(), doc.size(), column, ts,
+                                       GET_LATEST, result));
+    BOOST_CHECK_EQUAL(result, ExpressionValue(3, ts));
+
+    // Including within the object on the path, and with surrogate pairs
+    doc = "{\"\\ud83d\\ude00\": 1, "
+        "\"user\": {\"i\\u0064s\": 2, \"\\\"id\\\"\": 4, \"id\": 5}}";
+    BOOST_REQUIRE(tryExtractJsonColumn(doc.c_str(), doc.size(), column, ts,
+                                       GET_LATEST, result));
+    BOOST_CHECK_EQUAL(result, ExpressionValue(5, ts));
+}
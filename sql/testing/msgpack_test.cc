@@ -0,0 +1,189 @@
+/* msgpack_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Tests for the MessagePack encoding of ExpressionValues.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/sql/msgpack.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/arch/exception_handler.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+static std::string encode(const CellValue & val)
+{
+    MsgPackWriter writer;
+    writer.write(val);
+    return writer.bytes;
+}
+
+static CellValue roundTrip(const CellValue & val)
+{
+    std::string bytes = encode(val);
+    MsgPackReader reader(bytes);
+    CellValue result = reader.readAtom();
+    BOOST_CHECK(reader.eof());
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( test_integers )
+{
+    // Smallest encodings, from the specification
+    BOOST_CHECK_EQUAL(encode(5), "\x05");
+    BOOST_CHECK_EQUAL(encode(-1), "\xff");
+    BOOST_CHECK_EQUAL(encode(200), std::string("\xcc\xc8"));
+    BOOST_CHECK_EQUAL(encode(-33), std::string("\xd0\xdf"));
+    BOOST_CHECK_EQUAL(encode(65536).size(), 5);
+
+    for (long long val: { 0LL, 127LL, 128LL, -32LL, -129LL, 70000LL,
+                          -70000LL, 1LL << 40, -(1LL << 40),
+                          std::numeric_limits<long long>::min(),
+                          std::numeric_limits<long long>::max() }) {
+        BOOST_CHECK_EQUAL(roundTrip(val), CellValue(val));
+    }
+
+    unsigned long long big = std::numeric_limits<unsigned long long>::max();
+    BOOST_CHECK_EQUAL(roundTrip(big).toUInt(), big);
+}
+
+BOOST_AUTO_TEST_CASE( test_atoms )
+{
+    BOOST_CHECK(roundTrip(CellValue()).empty());
+
+    double d = 0.1 + 0.2;
+    BOOST_CHECK_EQUAL(roundTrip(d).toDouble(), d);
+
+    for (size_t len: { 0, 31, 32, 255, 256, 70000 }) {
+        std::string str(len, 'x');
+        BOOST_CHECK_EQUAL(roundTrip(str).toString(), str);
+    }
+    BOOST_CHECK_EQUAL(encode("abc"), "\xa3" "abc");
+
+    Utf8String utf8("caf\xc3\xa9");
+    BOOST_CHECK_EQUAL(roundTrip(utf8).toUtf8String(), utf8);
+
+    std::string blob("\x00\x01\xff", 3);
+    CellValue blobVal = CellValue::blob(blob);
+    BOOST_CHECK_EQUAL(encode(blobVal), std::string("\xc4\x03", 2) + blob);
+    BOOST_CHECK_EQUAL(roundTrip(blobVal), blobVal);
+
+    // Booleans are read as integers, like everywhere else in SQL
+    MsgPackReader reader("\xc3", 1);
+    BOOST_CHECK_EQUAL(reader.readAtom(), CellValue(1));
+}
+
+BOOST_AUTO_TEST_CASE( test_timestamps )
+{
+    // Whole seconds use the 32 bit form
+    Date ts = Date::fromSecondsSinceEpoch(1460000000);
+    BOOST_CHECK_EQUAL(encode(ts).size(), 6);
+    BOOST_CHECK_EQUAL(roundTrip(ts), CellValue(ts));
+
+    // Fractions use the 64 bit form
+    Date frac = Date::fromSecondsSinceEpoch(1460000000.25);
+    BOOST_CHECK_EQUAL(encode(frac).size(), 10);
+    BOOST_CHECK_EQUAL(roundTrip(frac), CellValue(frac));
+
+    // Before the epoch uses the 96 bit form
+    Date before = Date::fromSecondsSinceEpoch(-1000.5);
+    BOOST_CHECK_EQUAL(encode(before).size(), 15);
+    BOOST_CHECK_EQUAL(roundTrip(before), CellValue(before));
+
+    BOOST_CHECK(roundTrip(Date::notADate()).empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_rows )
+{
+    Date ts = Date::fromSecondsSinceEpoch(1000);
+
+    StructValue inner;
+    inner.emplace_back(PathElement("x"), ExpressionValue(1.5, ts));
+    inner.emplace_back(PathElement("y"), ExpressionValue("hello", ts));
+
+    StructValue list;
+    list.emplace_back(PathElement(0), ExpressionValue(1, ts));
+    list.emplace_back(PathElement(1), ExpressionValue(2, ts));
+
+    StructValue row;
+    row.emplace_back(PathElement("inner"), std::move(inner));
+    row.emplace_back(PathElement("list"), std::move(list));
+    row.emplace_back(PathElement("none"), ExpressionValue::null(ts));
+    ExpressionValue val(std::move(row));
+
+    MsgPackWriter writer;
+    writer.write(val);
+
+    // A row numbered from zero is written as an array
+    BOOST_CHECK(writer.bytes.find("\xa4list\x92\x01\x02")
+                != std::string::npos);
+
+    MsgPackReader reader(writer.bytes);
+    ExpressionValue read = reader.readValue(ts);
+    BOOST_CHECK(reader.eof());
+    BOOST_CHECK_EQUAL(read.extractJson(), val.extractJson());
+    BOOST_CHECK_EQUAL(read.getColumn(PathElement("none")).getAtom(),
+                      CellValue());
+
+    // Embeddings are nested arrays
+    MsgPackWriter embeddingWriter;
+    embeddingWriter.write(ExpressionValue(std::vector<float>{ 1.5, 2.5, 3.5 },
+                                          ts));
+    BOOST_CHECK_EQUAL(embeddingWriter.bytes.substr(0, 2), "\x93\xcb");
+}
+
+BOOST_AUTO_TEST_CASE( test_skip )
+{
+    MsgPackWriter writer;
+    writer.startArray(2);
+    writer.write(Json::parse("{\"a\": [1, {\"b\": null}], \"c\": \"d\"}"));
+    writer.writeInt(42);
+
+    MsgPackReader reader(writer.bytes);
+    BOOST_CHECK_EQUAL(reader.readArray(), 2);
+    reader.skip();
+    BOOST_CHECK_EQUAL(reader.readAtom(), CellValue(42));
+    BOOST_CHECK(reader.eof());
+}
+
+BOOST_AUTO_TEST_CASE( test_malformed )
+{
+    MLDB_TRACE_EXCEPTIONS(false);
+
+    // Truncated string
+    {
+        MsgPackReader reader("\xa5" "abc", 4);
+        BOOST_CHECK_THROW(reader.readAtom(), AnnotatedException);
+    }
+
+    // Length that is far too big
+    {
+        MsgPackReader reader("\xdb\xff\xff\xff\xff", 5);
+        BOOST_CHECK_THROW(reader.readValue(Date()), AnnotatedException);
+    }
+
+    // Reserved type byte
+    {
+        MsgPackReader reader("\xc1", 1);
+        BOOST_CHECK_THROW(reader.readValue(Date()), AnnotatedException);
+    }
+
+    // Unknown extension type
+    {
+        MsgPackReader reader("\xd4\x05\x00", 3);
+        BOOST_CHECK_THROW(reader.readAtom(), AnnotatedException);
+    }
+
+    // Empty input
+    {
+        MsgPackReader reader("", 0);
+        BOOST_CHECK_THROW(reader.readValue(Date()), AnnotatedException);
+    }
+}
@@ -1,10 +1,10 @@
-/** path_test.cc
+/** path_benchmark.cc
     Jeremy Barnes, 10 April 2016
     Copyright (c) 2015 mldb.ai inc.  All rights reserved.
 
     This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
 
-    Test of coordinate classes.
+    Benchmark of the construction, hashing and comparison of paths.
 */
 
 #include "mldb/types/path.h"
@@ -23,6 +23,8 @@
 #include <boost/test/unit_test.hpp>
 #include <tuple>
 #include <iostream>
+#include <random>
+#include <algorithm>
 
 using namespace std;
 
@@ -73,3 +75,117 @@ BOOST_AUTO_TEST_CASE( test_hash_speed )
     cerr << "New hash : " << paths.size() * numIter << " in " << elapsed2 * 1000
          << "ms at " << paths.size() * numIter / elapsed2 << " hashes per second" << endl;
 }
+
+namespace {
+
+std::vector<std::string> readColumnNames()
+{
+    std::vector<std::string> result;
+    filter_istream stream("mldb/sql/testing/path_test_columns.txt");
+    while (stream) {
+        std::string s;
+        getline(stream, s);
+        if (!s.empty())
+            result.emplace_back(std::move(s));
+    }
+    return result;
+}
+
+void report(const char * what, size_t n, double elapsed)
+{
+    cerr << what << ": " << n << " in " << elapsed * 1000 << "ms at "
+         << n / elapsed << " per second" << endl;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_construction_speed )
+{
+    vector<std::string> names = readColumnNames();
+    int numIter = 10;
+    size_t total = 0;
+
+    Date before = Date::now();
+    for (size_t i = 0;  i < numIter;  ++i) {
+        for (auto & s: names) {
+            Path p{PathElement(s)};
+            total += p.size();
+        }
+    }
+    Date between = Date::now();
+    for (size_t i = 0;  i < numIter;  ++i) {
+        for (auto & s: names) {
+            Path p = PathElement("prefix") + PathElement(s);
+            total += p.size();
+        }
+    }
+    Date between2 = Date::now();
+    for (size_t i = 0;  i < numIter;  ++i) {
+        for (auto & s: names) {
+            total += Path::parse(s).size();
+        }
+    }
+    Date after = Date::now();
+
+    cerr << "total = " << total << endl;
+    report("One element", names.size() * numIter, between.secondsSince(before));
+    report("Two elements", names.size() * numIter,
+           between2.secondsSince(between));
+    report("Parsed", names.size() * numIter, after.secondsSince(between2));
+}
+
+BOOST_AUTO_TEST_CASE( test_cached_hash_speed )
+{
+    vector<Path> paths;
+    for (auto & s: readColumnNames())
+        paths.emplace_back(PathElement(s));
+
+    int numIter = 10;
+    size_t totalHash = 0;
+
+    // The first time calculates the hashes; after that they are cached
+    Date before = Date::now();
+    for (auto & p: paths)
+        totalHash += p.hash();
+    Date between = Date::now();
+    for (size_t i = 0;  i < numIter;  ++i) {
+        for (auto & p: paths)
+            totalHash += p.hash();
+    }
+    Date after = Date::now();
+
+    cerr << "totalHash = " << totalHash << endl;
+    report("First hash", paths.size(), between.secondsSince(before));
+    report("Cached hash", paths.size() * numIter, after.secondsSince(between));
+}
+
+BOOST_AUTO_TEST_CASE( test_compare_speed )
+{
+    vector<Path> paths, twoElements;
+    for (auto & s: readColumnNames()) {
+        paths.emplace_back(PathElement(s));
+        twoElements.emplace_back(PathElement("x") + PathElement(s));
+    }
+
+    std::mt19937 rng(1);
+    std::shuffle(paths.begin(), paths.end(), rng);
+    std::shuffle(twoElements.begin(), twoElements.end(), rng);
+
+    Date before = Date::now();
+    std::sort(paths.begin(), paths.end());
+    Date between = Date::now();
+    std::sort(twoElements.begin(), twoElements.end());
+    Date between2 = Date::now();
+
+    size_t numEqual = 0;
+    for (size_t i = 0;  i < paths.size();  ++i) {
+        for (size_t j = i;  j < paths.size() && j < i + 10;  ++j)
+            numEqual += paths[i] == paths[j];
+    }
+    Date after = Date::now();
+
+    cerr << "numEqual = " << numEqual << endl;
+    report("Sort one element", paths.size(), between.secondsSince(before));
+    report("Sort two elements", paths.size(), between2.secondsSince(between));
+    report("Equality", paths.size() * 10, after.secondsSince(between2));
+}
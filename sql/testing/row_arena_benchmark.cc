@@ -0,0 +1,132 @@
+/** row_arena_benchmark.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test of the row arena, and comparison of the speed of creating rows
+    with and without it.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/sql/row_arena.h"
+#include "mldb/sql/expression_value.h"
+#include "mldb/base/optimized_path.h"
+#include "mldb/types/date.h"
+#include "mldb/arch/exception_handler.h"
+#include <thread>
+#include <iostream>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_arena_lifetime )
+{
+    BOOST_REQUIRE_EQUAL(RowArena::numLiveBlocks(), 0);
+
+    std::vector<void *> kept;
+    {
+        RowArena arena(4096);
+        for (int i = 0;  i < 1000;  ++i) {
+            void * p = arena.allocate(i % 100 + 1);
+            BOOST_CHECK_EQUAL((size_t)p % alignof(std::max_align_t), 0);
+            memset(p, i, i % 100 + 1);
+            if (i % 100 == 0)
+                kept.push_back(p);
+            else RowArena::deallocate(p);
+        }
+
+        // Too big for a block
+        void * big = arena.allocate(100000);
+        RowArena::deallocate(big);
+
+        // Blocks that still have allocations are alive
+        BOOST_CHECK_GT(RowArena::numLiveBlocks(), 1);
+    }
+
+    // Values that outlive the arena keep their blocks, and they are freed
+    // from another thread
+    BOOST_CHECK_GT(RowArena::numLiveBlocks(), 0);
+    std::thread([&] () { for (auto p: kept) RowArena::deallocate(p); }).join();
+    BOOST_CHECK_EQUAL(RowArena::numLiveBlocks(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_arena_reuse )
+{
+    // A batch whose values are all freed has its block reused
+    RowArena arena;
+    for (int batch = 0;  batch < 100;  ++batch) {
+        arena.newBatch();
+        std::vector<void *> values;
+        for (int i = 0;  i < 100;  ++i)
+            values.push_back(arena.allocate(64));
+        for (auto p: values)
+            RowArena::deallocate(p);
+        BOOST_CHECK_EQUAL(RowArena::numLiveBlocks(), 1);
+    }
+}
+
+// Make rows like a SELECT produces, and keep one in every keepEvery of
+// them in the output
+static double makeRows(bool useArena, int keepEvery,
+                       std::vector<ExpressionValue> & output)
+{
+    OptimizedPath::setOptimization("mldb.sql.useRowArena",
+                                   useArena ? OptimizedPath::ALWAYS
+                                   : OptimizedPath::NEVER);
+
+    Date ts;
+    std::vector<PathElement> columns;
+    for (int i = 0;  i < 10;  ++i)
+        columns.emplace_back("column" + std::to_string(i));
+
+    Date before = Date::now();
+
+    RowArena arena;
+    for (int batch = 0;  batch < 100;  ++batch) {
+        arena.newBatch();
+        RowArenaScope scope(&arena);
+        for (int i = 0;  i < 1000;  ++i) {
+            StructValue inner;
+            inner.reserve(2);
+            inner.emplace_back(PathElement("x"), ExpressionValue(i, ts));
+            inner.emplace_back(PathElement("y"), ExpressionValue(batch, ts));
+
+            StructValue row;
+            row.reserve(columns.size() + 1);
+            for (auto & c: columns)
+                row.emplace_back(c, ExpressionValue(i * batch, ts));
+            row.emplace_back(PathElement("z"), std::move(inner));
+
+            ExpressionValue value(std::move(row));
+            if (i % keepEvery == 0)
+                output.emplace_back(std::move(value));
+        }
+    }
+
+    return Date::now().secondsSince(before);
+}
+
+BOOST_AUTO_TEST_CASE( test_arena_speed )
+{
+    for (int keepEvery: { 1, 100, 1000000 }) {
+        std::vector<ExpressionValue> withArena, without;
+        double arenaTime = makeRows(true, keepEvery, withArena);
+        double normalTime = makeRows(false, keepEvery, without);
+
+        cerr << "keeping 1 in " << keepEvery << " rows: arena "
+             << arenaTime << "s, normal " << normalTime << "s" << endl;
+
+        BOOST_REQUIRE_EQUAL(withArena.size(), without.size());
+        for (size_t i = 0;  i < withArena.size();  ++i)
+            BOOST_CHECK_EQUAL(withArena[i], without[i]);
+    }
+
+    BOOST_CHECK_EQUAL(RowArena::numLiveBlocks(), 0);
+
+    OptimizedPath::setOptimization("mldb.sql.useRowArena",
+                                   OptimizedPath::DEFAULT);
+}
@@ -0,0 +1,296 @@
+/** sql_batch_test.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test that batch execution of expressions gives the same results as
+    row execution.
+*/
+
+#include "mldb/sql/sql_batch.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/types/value_description.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+
+using namespace MLDB;
+
+
+/** Scope with columns held in memory, which can be read either a row at a
+    time or for a whole batch.
+*/
+struct TestScope: public SqlBindingScope {
+
+    std::map<ColumnPath, std::vector<CellValue> > columns;
+    size_t numRows = 0;
+
+    struct RowScope: public SqlRowScope {
+        RowScope(uint32_t row)
+            : row(row)
+        {
+        }
+
+        uint32_t row;
+    };
+
+    void addColumn(const ColumnPath & name, std::vector<CellValue> values)
+    {
+        numRows = values.size();
+        columns[name] = std::move(values);
+    }
+
+    virtual ColumnGetter doGetColumn(const Utf8String & tableName,
+                                     const ColumnPath & columnName) override
+    {
+        auto it = columns.find(columnName);
+        if (it == columns.end())
+            return SqlBindingScope::doGetColumn(tableName, columnName);
+        const std::vector<CellValue> * values = &it->second;
+
+        return {[=] (const SqlRowScope & scope,
+                     ExpressionValue & storage,
+                     const VariableFilter & filter) -> const ExpressionValue &
+                {
+                    auto & row = scope.as<RowScope>();
+                    return storage = ExpressionValue((*values)[row.row],
+                                                     Date::notADate());
+                },
+                std::make_shared<AtomValueInfo>()};
+    }
+
+    virtual BatchColumnGetter
+    doGetColumnBatch(const Utf8String & tableName,
+                     const ColumnPath & columnName) override
+    {
+        return [=] (const SqlBatch & batch,
+                    const SqlSelection & selection,
+                    SqlBatchVector & out)
+            {
+                return batch.readColumn(columnName, selection, out);
+            };
+    }
+};
+
+struct TestBatch: public SqlBatch {
+    TestBatch(const TestScope & scope)
+        : SqlBatch(scope.numRows), scope(scope)
+    {
+    }
+
+    const TestScope & scope;
+
+    virtual bool readColumn(const ColumnPath & columnName,
+                            const SqlSelection & selection,
+                            SqlBatchVector & out) const override
+    {
+        std::vector<CellValue> values;
+        for (uint32_t row: selection)
+            values.push_back(scope.columns.at(columnName).at(row));
+        out.initCells(std::move(values));
+        return true;
+    }
+
+    virtual ExpressionValue evalRow(const BoundSqlExpression & expr,
+                                    uint32_t row) const override
+    {
+        return expr(TestScope::RowScope(row), GET_LATEST);
+    }
+};
+
+TestScope makeScope()
+{
+    TestScope scope;
+    scope.addColumn(PathElement("x"),
+                    { 1, 2, CellValue(), -3, 0, 7, 1000000, 5 });
+    scope.addColumn(PathElement("y"),
+                    { 0.5, 2, 3.25, CellValue(), 0, -1.5,
+                      std::numeric_limits<double>::quiet_NaN(), 5 });
+    scope.addColumn(PathElement("s"),
+                    { "hello", 2, CellValue(), "world", 1.5, "", "7", 5 });
+    // No nulls, for functions that don't accept them
+    scope.addColumn(PathElement("n"),
+                    { 1, -2, 0.5, 3, 0, 7, -1.5, 1000 });
+    return scope;
+}
+
+void checkSame(TestScope & scope, const std::string & surface)
+{
+    BOOST_TEST_CHECKPOINT(surface);
+    cerr << "testing " << surface << endl;
+
+    auto expr = SqlExpression::parse(surface);
+    auto bound = expr->bind(scope);
+
+    BOOST_REQUIRE(isBatchable(bound));
+
+    TestBatch batch(scope);
+    SqlSelection selection = selectAll(scope.numRows);
+
+    SqlBatchVector batchResult;
+    evalBatch(bound, batch, selection, batchResult);
+
+    BOOST_REQUIRE_EQUAL(batchResult.size(), scope.numRows);
+
+    for (size_t i = 0;  i < scope.numRows;  ++i) {
+        CellValue rowValue;
+        bool rowThrew = false;
+        try {
+            rowValue = bound(TestScope::RowScope(i), GET_LATEST).getAtom();
+        } catch (const std::exception & exc) {
+            rowThrew = true;
+        }
+        BOOST_REQUIRE(!rowThrew);
+
+        CellValue batchValue = batchResult.getCell(i);
+
+        BOOST_CHECK_EQUAL(batchValue.cellType(), rowValue.cellType());
+        if (rowValue.isNaN())
+            BOOST_CHECK(batchValue.isNaN());
+        else BOOST_CHECK_EQUAL(batchValue, rowValue);
+    }
+
+    // Filtering on a selection must match filtering each row
+    SqlSelection filtered = filterBatch(bound, batch, selection);
+    SqlSelection expected;
+    for (size_t i = 0;  i < scope.numRows;  ++i) {
+        if (bound(TestScope::RowScope(i), GET_LATEST).isTrue())
+            expected.push_back(i);
+    }
+    BOOST_CHECK_EQUAL_COLLECTIONS(filtered.begin(), filtered.end(),
+                                  expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_arithmetic)
+{
+    TestScope scope = makeScope();
+
+    checkSame(scope, "x");
+    checkSame(scope, "x + 1");
+    checkSame(scope, "x + y");
+    checkSame(scope, "x - y * 2");
+    checkSame(scope, "x / 2");
+    checkSame(scope, "y / x");
+    checkSame(scope, "x % 3");
+    checkSame(scope, "y % 2");
+    checkSame(scope, "x % -4");
+    checkSame(scope, "-x");
+    checkSame(scope, "-y");
+    checkSame(scope, "x * 1000000 * 1000000");
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_comparisons)
+{
+    TestScope scope = makeScope();
+
+    checkSame(scope, "x = 1");
+    checkSame(scope, "x != y");
+    checkSame(scope, "x > y");
+    checkSame(scope, "x <= 2");
+    checkSame(scope, "y >= 0");
+    checkSame(scope, "s = 'hello'");
+    checkSame(scope, "s < 'z'");
+    checkSame(scope, "s = x");
+    checkSame(scope, "x BETWEEN 0 AND 5");
+    checkSame(scope, "y NOT BETWEEN x AND 3");
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_boolean)
+{
+    TestScope scope = makeScope();
+
+    checkSame(scope, "x > 0 AND y > 0");
+    checkSame(scope, "x > 0 OR y > 0");
+    checkSame(scope, "NOT x > 0");
+    checkSame(scope, "x AND y");
+    checkSame(scope, "s OR x");
+    checkSame(scope, "NOT s");
+    checkSame(scope, "x IS NULL");
+    checkSame(scope, "y IS NOT NULL");
+    checkSame(scope, "s IS STRING");
+    checkSame(scope, "s IS NOT NUMBER");
+    checkSame(scope, "true AND x > 1");
+    checkSame(scope, "NULL OR x > 1");
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_case)
+{
+    TestScope scope = makeScope();
+
+    checkSame(scope, "CASE WHEN x > 2 THEN 'big' WHEN x > 0 THEN y ELSE s END");
+    checkSame(scope, "CASE WHEN x > 0 THEN x END");
+    checkSame(scope, "CASE x WHEN 1 THEN 'one' WHEN 2 THEN 2.5 ELSE x * 2 END");
+    checkSame(scope, "CASE WHEN x = 0 THEN 0 ELSE 10 % x END");
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_functions)
+{
+    TestScope scope = makeScope();
+
+    checkSame(scope, "abs(x)");
+    checkSame(scope, "abs(y) + 1");
+    checkSame(scope, "sqrt(abs(y))");
+    // power() doesn't accept nulls, in either mode
+    checkSame(scope, "power(n, 2)");
+    checkSame(scope, "ln(x + 10)");
+    checkSame(scope, "lower(s)");
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_selection)
+{
+    // Evaluation and filtering of a subset of the rows
+    TestScope scope = makeScope();
+    auto bound = SqlExpression::parse("x + y > 2")->bind(scope);
+    TestBatch batch(scope);
+
+    SqlSelection selection = { 1, 2, 5, 7 };
+    SqlSelection filtered = filterBatch(bound, batch, selection);
+
+    SqlSelection expected = { 1, 5, 7 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(filtered.begin(), filtered.end(),
+                                  expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_vector_append)
+{
+    auto check = [] (const SqlBatchVector & v,
+                     const std::vector<CellValue> & expected)
+        {
+            BOOST_REQUIRE_EQUAL(v.size(), expected.size());
+            for (size_t i = 0;  i < expected.size();  ++i)
+                BOOST_CHECK_EQUAL(v.getCell(i), expected[i]);
+        };
+
+    // Same kind stays typed, and nulls are kept on both sides
+    SqlBatchVector ints, moreInts;
+    ints.initCells({ 1, 2 });
+    moreInts.initCells({ CellValue(), 4 });
+    ints.append(moreInts);
+    BOOST_CHECK_EQUAL(ints.kind, SqlBatchVector::INTEGER);
+    check(ints, { 1, 2, CellValue(), 4 });
+
+    SqlBatchVector nullFirst;
+    nullFirst.initCells({ CellValue(), 0.5 });
+    SqlBatchVector noNulls;
+    noNulls.initCells({ 1.5 });
+    nullFirst.append(noNulls);
+    BOOST_CHECK_EQUAL(nullFirst.kind, SqlBatchVector::DOUBLE);
+    check(nullFirst, { CellValue(), 0.5, 1.5 });
+
+    // Different kinds become atoms
+    SqlBatchVector strings;
+    strings.initCells({ "hello" });
+    ints.append(strings);
+    BOOST_CHECK_EQUAL(ints.kind, SqlBatchVector::ATOM);
+    check(ints, { 1, 2, CellValue(), 4, "hello" });
+
+    // Appending to an empty vector takes the other's kind
+    SqlBatchVector empty;
+    empty.append(noNulls);
+    BOOST_CHECK_EQUAL(empty.kind, SqlBatchVector::DOUBLE);
+    check(empty, { 1.5 });
+}
@@ -0,0 +1,186 @@
+/** sql_parser_benchmark.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test of the parser's fast paths, and how long it takes to parse the
+    kind of queries that are generated by programs: thousands of columns,
+    large IN lists and literal arrays.
+*/
+
+#include "mldb/sql/sql_expression.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/types/date.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+
+using namespace std;
+
+using namespace MLDB;
+
+
+template<typename T>
+static std::shared_ptr<T> as(const std::shared_ptr<SqlExpression> & expr)
+{
+    auto result = std::dynamic_pointer_cast<T>(expr);
+    BOOST_REQUIRE(result);
+    return result;
+}
+
+static bool isConstant(const std::shared_ptr<SqlExpression> & expr)
+{
+    return !!std::dynamic_pointer_cast<ConstantExpression>(expr);
+}
+
+BOOST_AUTO_TEST_CASE( test_constant_elements )
+{
+    // Only whole elements that are numbers or strings are parsed as
+    // constants directly; the rest have the same parse as before
+    auto in = as<InExpression>
+        (SqlExpression::parse("x IN (1, 2 + 3,'a' , -4, 5.5 )"));
+    auto & clauses = in->tuple->clauses;
+    BOOST_REQUIRE_EQUAL(clauses.size(), 5);
+    BOOST_CHECK(isConstant(clauses[0]));
+    BOOST_CHECK_EQUAL(clauses[0]->surface, "1");
+    BOOST_CHECK(!isConstant(clauses[1]));
+    BOOST_CHECK_EQUAL(clauses[1]->surface, "2 + 3");
+    BOOST_CHECK(isConstant(clauses[2]));
+    BOOST_CHECK_EQUAL(clauses[2]->surface, "'a'");
+    BOOST_CHECK(!isConstant(clauses[3]));
+    BOOST_CHECK_EQUAL(clauses[3]->surface, "-4");
+    BOOST_CHECK(isConstant(clauses[4]));
+    BOOST_CHECK_EQUAL(clauses[4]->surface, "5.5");
+
+    auto embedding = as<EmbeddingLiteralExpression>
+        (SqlExpression::parse("[1, 2.5, 'it''s', a, 3 * 2, 'b'[0]]"));
+    BOOST_REQUIRE_EQUAL(embedding->clauses.size(), 6);
+    BOOST_CHECK(isConstant(embedding->clauses[0]));
+    BOOST_CHECK(isConstant(embedding->clauses[1]));
+    BOOST_CHECK(isConstant(embedding->clauses[2]));
+    BOOST_CHECK_EQUAL(embedding->clauses[2]->surface, "'it''s'");
+    BOOST_CHECK(!isConstant(embedding->clauses[3]));
+    BOOST_CHECK(!isConstant(embedding->clauses[4]));
+    BOOST_CHECK(!isConstant(embedding->clauses[5]));
+
+    auto call = as<FunctionCallExpression>
+        (SqlExpression::parse("f(1, 'x', y)"));
+    BOOST_REQUIRE_EQUAL(call->args.size(), 3);
+    BOOST_CHECK(isConstant(call->args[0]));
+    BOOST_CHECK(isConstant(call->args[1]));
+    BOOST_CHECK(!isConstant(call->args[2]));
+}
+
+BOOST_AUTO_TEST_CASE( test_keywords_and_names )
+{
+    // Keywords in any case, and after whitespace and comments
+    auto in = as<InExpression>
+        (SqlExpression::parse("x not in /* comment */ (1,2)"));
+    BOOST_CHECK(in->isNegative);
+    BOOST_CHECK_EQUAL(in->tuple->clauses.size(), 2);
+
+    as<IsTypeExpression>(SqlExpression::parse("x is\n-- comment\nnot null"));
+    as<BetweenExpression>(SqlExpression::parse("x BETWEEN 1 AND 2"));
+
+    auto read = as<ReadColumnExpression>
+        (SqlExpression::parse("\"quoted\"\".name\".b_2.c3"));
+    BOOST_REQUIRE_EQUAL(read->columnName.size(), 3);
+    BOOST_CHECK_EQUAL(read->columnName[0].toUtf8String(), "quoted\".name");
+    BOOST_CHECK_EQUAL(read->columnName[1].toUtf8String(), "b_2");
+    BOOST_CHECK_EQUAL(read->columnName[2].toUtf8String(), "c3");
+
+    // Each of the forms of a select clause
+    auto select = SelectExpression::parse("a: b, x*, c * 2, d AS e, y* AS z*, *");
+    BOOST_REQUIRE_EQUAL(select.clauses.size(), 6);
+    auto named = std::dynamic_pointer_cast<NamedColumnExpression>
+        (select.clauses[0]);
+    BOOST_REQUIRE(named);
+    BOOST_CHECK_EQUAL(named->alias, ColumnPath("a"));
+    BOOST_CHECK(std::dynamic_pointer_cast<WildcardExpression>
+                (select.clauses[1]));
+    named = std::dynamic_pointer_cast<NamedColumnExpression>
+        (select.clauses[2]);
+    BOOST_REQUIRE(named);
+    BOOST_CHECK_EQUAL(named->alias, ColumnPath("c * 2"));
+    named = std::dynamic_pointer_cast<NamedColumnExpression>
+        (select.clauses[3]);
+    BOOST_REQUIRE(named);
+    BOOST_CHECK_EQUAL(named->alias, ColumnPath("e"));
+    BOOST_CHECK(std::dynamic_pointer_cast<WildcardExpression>
+                (select.clauses[4]));
+    BOOST_CHECK(std::dynamic_pointer_cast<WildcardExpression>
+                (select.clauses[5]));
+}
+
+/** Queries like those that feature generation programs write. */
+static std::vector<std::pair<std::string, std::string> > queryCorpus()
+{
+    std::vector<std::pair<std::string, std::string> > result;
+
+    std::string columns = "SELECT ";
+    for (int i = 0;  i < 5000;  ++i) {
+        if (i != 0)
+            columns += ", ";
+        switch (i % 5) {
+        case 0: columns += "col" + to_string(i); break;
+        case 1: columns += "f" + to_string(i) + ": col" + to_string(i) + " * 0.5 + 1"; break;
+        case 2: columns += "CASE WHEN col" + to_string(i) + " IS NULL THEN 0 ELSE col"
+                + to_string(i) + " END AS c" + to_string(i); break;
+        case 3: columns += "log(col" + to_string(i) + " + 1) AS l" + to_string(i); break;
+        case 4: columns += "\"col " + to_string(i) + "\" = 'value " + to_string(i)
+                + "' AS e" + to_string(i); break;
+        }
+    }
+    columns += " FROM ds";
+    result.emplace_back("5000 columns", columns);
+
+    std::string inList = "SELECT * FROM ds WHERE x IN (";
+    for (int i = 0;  i < 20000;  ++i)
+        inList += (i ? ", " : "") + to_string(i * 7);
+    inList += ")";
+    result.emplace_back("20000 integer IN list", inList);
+
+    std::string stringInList = "SELECT * FROM ds WHERE x NOT IN (";
+    for (int i = 0;  i < 20000;  ++i)
+        stringInList += (i ? ", '" : "'") + to_string(i * 7) + "'";
+    stringInList += ")";
+    result.emplace_back("20000 string IN list", stringInList);
+
+    std::string embedding = "SELECT [";
+    for (int i = 0;  i < 20000;  ++i)
+        embedding += (i ? ", " : "") + to_string(i * 0.25);
+    embedding += "] AS embedding FROM ds";
+    result.emplace_back("20000 element embedding", embedding);
+
+    std::string orChain = "SELECT * FROM ds WHERE ";
+    for (int i = 0;  i < 1000;  ++i)
+        orChain += (i ? " OR x = " : "x = ") + to_string(i);
+    result.emplace_back("1000 term OR chain", orChain);
+
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( benchmark_generated_queries )
+{
+    for (auto & query: queryCorpus()) {
+        int numRepeats = 3;
+        double best = INFINITY;
+        SelectStatement statement;
+        for (int repeat = 0;  repeat < numRepeats;  ++repeat) {
+            Date before = Date::now();
+            statement = SelectStatement::parse(query.second);
+            best = std::min(best, Date::now().secondsSince(before));
+        }
+
+        cerr << query.first << " (" << query.second.size() << " chars): "
+             << best * 1000 << "ms" << endl;
+        BOOST_CHECK_EQUAL(statement.surface, query.second);
+    }
+
+    auto statement = SelectStatement::parse(queryCorpus()[0].second);
+    BOOST_CHECK_EQUAL(statement.select.clauses.size(), 5000);
+    statement = SelectStatement::parse(queryCorpus()[1].second);
+    BOOST_CHECK_EQUAL(as<InExpression>(statement.where)->tuple->clauses.size(),
+                      20000);
+}
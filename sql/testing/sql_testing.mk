@@ -6,3 +6,10 @@ $(eval $(call test,path_test,sql_types,boost valgrind))
 $(eval $(call test,path_order_test,sql_types,boost))
 $(eval $(call test,path_benchmark,sql_types,boost))
 $(eval $(call test,eval_sql_test,sql_expression,boost))
+$(eval $(call test,sql_batch_test,sql_expression,boost))
+$(eval $(call test,row_arena_benchmark,sql_expression,boost))
+$(eval $(call test,json_extract_test,sql_expression,boost))
+$(eval $(call test,msgpack_test,sql_expression,boost))
+$(eval $(call test,value_snapshot_test,sql_expression,boost))
+$(eval $(call test,typed_operator_benchmark,sql_expression,boost))
+$(eval $(call test,sql_parser_benchmark,sql_expression,boost))
@@ -0,0 +1,204 @@
+/** typed_operator_benchmark.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test that the arithmetic and comparison operators specialized on the
+    storage of their operands give the same results as the generic ones,
+    and comparison of their speed.
+*/
+
+#include "mldb/sql/sql_expression.h"
+#include "mldb/base/optimized_path.h"
+#include "mldb/types/date.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+
+using namespace MLDB;
+
+
+/** Scope with columns held in memory, each of which has a value info
+    that says how its values are stored.
+*/
+struct TestScope: public SqlBindingScope {
+
+    struct Column {
+        std::vector<CellValue> values;
+        std::shared_ptr<ExpressionValueInfo> info;
+    };
+
+    std::map<ColumnPath, Column> columns;
+    size_t numRows = 0;
+
+    struct RowScope: public SqlRowScope {
+        RowScope(uint32_t row)
+            : row(row)
+        {
+        }
+
+        uint32_t row;
+    };
+
+    void addColumn(const ColumnPath & name, std::vector<CellValue> values,
+                   std::shared_ptr<ExpressionValueInfo> info)
+    {
+        numRows = values.size();
+        columns[name] = { std::move(values), std::move(info) };
+    }
+
+    virtual ColumnGetter doGetColumn(const Utf8String & tableName,
+                                     const ColumnPath & columnName) override
+    {
+        auto it = columns.find(columnName);
+        if (it == columns.end())
+            return SqlBindingScope::doGetColumn(tableName, columnName);
+        const std::vector<CellValue> * values = &it->second.values;
+
+        return {[=] (const SqlRowScope & scope,
+                     ExpressionValue & storage,
+                     const VariableFilter & filter) -> const ExpressionValue &
+                {
+                    auto & row = scope.as<RowScope>();
+                    return storage = ExpressionValue((*values)[row.row],
+                                                     Date::notADate());
+                },
+                it->second.info};
+    }
+};
+
+/// Columns of each kind, including the values the info doesn't exclude:
+/// nulls, integral doubles, NaN and out of range unsigned integers
+TestScope makeScope(size_t numRows)
+{
+    std::vector<CellValue> i, j, u, x, y;
+    for (size_t n = 0;  n < numRows;  ++n) {
+        if (n % 10 == 3) {
+            i.emplace_back();
+            y.emplace_back();
+        }
+        else {
+            i.emplace_back((int64_t)(n % 1000) - 500);
+            y.emplace_back(n % 17 == 0 ? std::numeric_limits<double>::quiet_NaN()
+                           : n * 0.25 - 100);
+        }
+        j.emplace_back((int64_t)(n % 7) - 3);
+        u.emplace_back(n % 100 == 0 ? std::numeric_limits<uint64_t>::max()
+                       : (uint64_t)n);
+        x.emplace_back(n * 0.5);
+    }
+
+    TestScope scope;
+    scope.addColumn(PathElement("i"), std::move(i),
+                    std::make_shared<IntegerValueInfo>());
+    scope.addColumn(PathElement("j"), std::move(j),
+                    std::make_shared<IntegerValueInfo>());
+    scope.addColumn(PathElement("u"), std::move(u),
+                    std::make_shared<Uint64ValueInfo>());
+    scope.addColumn(PathElement("x"), std::move(x),
+                    std::make_shared<Float64ValueInfo>());
+    scope.addColumn(PathElement("y"), std::move(y),
+                    std::make_shared<Float64ValueInfo>());
+    return scope;
+}
+
+// Evaluate the expression over each row, repeated numRepeats times, with
+// or without the specialized operators
+static double run(TestScope & scope, const std::string & surface,
+                  bool typed, int numRepeats,
+                  std::vector<ExpressionValue> & output)
+{
+    OptimizedPath::setOptimization("mldb.sql.typedScalarOperators",
+                                   typed ? OptimizedPath::ALWAYS
+                                   : OptimizedPath::NEVER);
+
+    auto bound = SqlExpression::parse(surface)->bind(scope);
+
+    Date before = Date::now();
+
+    for (int repeat = 0;  repeat < numRepeats;  ++repeat) {
+        output.clear();
+        for (size_t n = 0;  n < scope.numRows;  ++n) {
+            ExpressionValue storage;
+            output.emplace_back(bound(TestScope::RowScope(n), storage,
+                                      GET_LATEST));
+        }
+    }
+
+    return Date::now().secondsSince(before);
+}
+
+static void checkSame(TestScope & scope, const std::string & surface,
+                      int numRepeats = 1)
+{
+    BOOST_TEST_CHECKPOINT(surface);
+
+    std::vector<ExpressionValue> typed, generic;
+    double typedTime = run(scope, surface, true, numRepeats, typed);
+    double genericTime = run(scope, surface, false, numRepeats, generic);
+
+    cerr << surface << ": typed " << typedTime << "s, generic "
+         << genericTime << "s" << endl;
+
+    BOOST_REQUIRE_EQUAL(typed.size(), generic.size());
+    for (size_t n = 0;  n < typed.size();  ++n) {
+        BOOST_TEST_CONTEXT(surface << " row " << n) {
+            const CellValue & t = typed[n].getAtom();
+            const CellValue & g = generic[n].getAtom();
+            BOOST_CHECK_EQUAL(t.cellType(), g.cellType());
+            if (g.isNaN())
+                BOOST_CHECK(t.isNaN());
+            else BOOST_CHECK_EQUAL(t, g);
+            BOOST_CHECK_EQUAL(typed[n].getEffectiveTimestamp(),
+                              generic[n].getEffectiveTimestamp());
+        }
+    }
+
+    OptimizedPath::setOptimization("mldb.sql.typedScalarOperators",
+                                   OptimizedPath::DEFAULT);
+}
+
+BOOST_AUTO_TEST_CASE( test_typed_arithmetic )
+{
+    TestScope scope = makeScope(1000);
+
+    checkSame(scope, "i + j");
+    checkSame(scope, "i - 1");
+    checkSame(scope, "i * x");
+    checkSame(scope, "y / j");
+    checkSame(scope, "u + i");
+    checkSame(scope, "u * 2.5");
+    checkSame(scope, "i % j");
+    checkSame(scope, "u % 7");
+    checkSame(scope, "x % 3");
+    checkSame(scope, "i * 1000000 * 1000000 * 1000000");
+}
+
+BOOST_AUTO_TEST_CASE( test_typed_comparisons )
+{
+    TestScope scope = makeScope(1000);
+
+    checkSame(scope, "i = j");
+    checkSame(scope, "i != 0");
+    checkSame(scope, "i < j");
+    checkSame(scope, "x >= y");
+    checkSame(scope, "y <= 10.5");
+    checkSame(scope, "x > i");
+    checkSame(scope, "u > i");
+    checkSame(scope, "u = u");
+    checkSame(scope, "y = y");
+}
+
+BOOST_AUTO_TEST_CASE( test_typed_operator_speed )
+{
+    TestScope scope = makeScope(100000);
+
+    for (auto surface: { "i + j", "x * y", "i - x", "i % 7",
+                         "i < j", "x >= y", "i = 3" }) {
+        checkSame(scope, surface, 10);
+    }
+}
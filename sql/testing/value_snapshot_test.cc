@@ -0,0 +1,278 @@
+/* value_snapshot_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Tests for the binary snapshots of ExpressionValues.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/sql/value_snapshot.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/arch/exception_handler.h"
+
+#include <cstring>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+static FrozenMemoryRegion freeze(std::string bytes)
+{
+    auto owner = std::make_shared<std::string>(std::move(bytes));
+    return FrozenMemoryRegion(owner, owner->data(), owner->size());
+}
+
+static ExpressionValue roundTrip(const ExpressionValue & val)
+{
+    ValueSnapshotWriter writer;
+    BOOST_CHECK_EQUAL(writer.add(val), 0);
+    std::string bytes = writer.finish();
+    ValueSnapshotReader reader(bytes.data(), bytes.size());
+    BOOST_REQUIRE_EQUAL(reader.size(), 1);
+    return reader.get(0);
+}
+
+BOOST_AUTO_TEST_CASE( test_atoms )
+{
+    Date ts = Date::fromSecondsSinceEpoch(1460000000.25);
+
+    std::vector<CellValue> atoms = {
+        CellValue(),
+        0, 1, -1, 1LL << 40, std::numeric_limits<long long>::min(),
+        std::numeric_limits<unsigned long long>::max(),
+        0.1 + 0.2, -1e300,
+        "", "abc", std::string(1000, 'x'),
+        Utf8String("caf\xc3\xa9"),
+        CellValue::blob(std::string("\x00\x01\xff", 3)),
+        CellValue(Path()), CellValue(PathElement("a") + PathElement("b.c")),
+        CellValue(Date::fromSecondsSinceEpoch(-1000.5)),
+        CellValue::fromMonthDaySecond(3, 2, 1.5),
+        CellValue::fromMonthDaySecond(0, -4, 0)
+    };
+
+    for (auto & atom: atoms) {
+        ExpressionValue read = roundTrip(ExpressionValue(atom, ts));
+        BOOST_REQUIRE(read.isAtom());
+        BOOST_CHECK_EQUAL(read.getAtom(), atom);
+        BOOST_CHECK_EQUAL(read.getAtom().cellType(), atom.cellType());
+        BOOST_CHECK_EQUAL(read.getEffectiveTimestamp(), ts);
+    }
+
+    BOOST_CHECK_EQUAL(roundTrip(ExpressionValue(atoms[6], ts)).getAtom()
+                      .toUInt(),
+                      std::numeric_limits<unsigned long long>::max());
+}
+
+BOOST_AUTO_TEST_CASE( test_views_point_into_snapshot )
+{
+    Date ts = Date::fromSecondsSinceEpoch(1000);
+    std::string str(100, 'y');
+
+    ValueSnapshotWriter writer;
+    writer.add(ExpressionValue(str, ts));
+    writer.add(ExpressionValue(42, ts));
+    std::string bytes = writer.finish();
+    BOOST_CHECK_EQUAL(writer.size(), 0);
+
+    FrozenMemoryRegion region = freeze(bytes);
+    ValueSnapshotReader reader(region);
+    BOOST_CHECK_EQUAL(reader.version(), VALUE_SNAPSHOT_VERSION);
+    BOOST_REQUIRE_EQUAL(reader.size(), 2);
+
+    ValueView val = reader[0];
+    BOOST_REQUIRE_EQUAL(val.kind(), ValueView::ATOM);
+    CellValueView atom = val.atom();
+    BOOST_CHECK_EQUAL(atom.type, CellValueView::ASCII_STRING);
+    BOOST_CHECK_EQUAL(atom.bytes, str);
+    BOOST_CHECK_EQUAL(val.timestamp(), ts);
+
+    // The bytes aren't copied out of the snapshot
+    BOOST_CHECK(atom.bytes.data() > region.data());
+    BOOST_CHECK(atom.bytes.data() + atom.bytes.size()
+                <= region.data() + region.length());
+
+    BOOST_CHECK_EQUAL(reader[1].atom().type, CellValueView::INTEGER);
+    BOOST_CHECK_EQUAL(reader[1].atom().intVal, 42);
+    BOOST_CHECK_EQUAL(reader[1].atom().toCell(), 42);
+
+    {
+        MLDB_TRACE_EXCEPTIONS(false);
+        BOOST_CHECK_THROW(reader[2], AnnotatedException);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_rows )
+{
+    Date ts = Date::fromSecondsSinceEpoch(1000);
+
+    ValueSnapshotWriter writer;
+    for (int i = 0;  i < 100;  ++i) {
+        StructValue inner;
+        inner.emplace_back(PathElement("x"), ExpressionValue(i * 1.5, ts));
+        inner.emplace_back(PathElement("y"),
+                           ExpressionValue("row" + to_string(i), ts));
+        StructValue row;
+        row.emplace_back(PathElement("inner"), std::move(inner));
+        row.emplace_back(PathElement("x"), ExpressionValue(i, ts));
+        row.emplace_back(PathElement("none"), ExpressionValue::null(ts));
+        writer.add(ExpressionValue(std::move(row)));
+    }
+
+    std::string bytes = writer.finish();
+    ValueSnapshotReader reader(bytes.data(), bytes.size());
+    BOOST_REQUIRE_EQUAL(reader.size(), 100);
+
+    // Each name is only in the dictionary once, however often it's used
+    BOOST_CHECK_EQUAL(reader.columnNames().size(), 4);
+
+    for (int i = 0;  i < 100;  ++i) {
+        ExpressionValue row = reader.get(i);
+        BOOST_REQUIRE(row.isRow());
+        BOOST_CHECK_EQUAL(row.getColumn(PathElement("x")).getAtom(), i);
+        BOOST_CHECK_EQUAL(row.getNestedColumn(PathElement("inner")
+                                              + PathElement("y"))
+                          .getAtom(),
+                          "row" + to_string(i));
+        BOOST_CHECK(row.getColumn(PathElement("none")).empty());
+    }
+
+    // Columns can be visited without decoding the whole row.  They are in
+    // the order that the row keeps them in, which is sorted.
+    ValueView view = reader[7];
+    BOOST_CHECK_EQUAL(view.rowLength(), 3);
+    std::vector<PathElement> names;
+    auto onColumn = [&] (uint32_t nameIndex, const ValueView & val)
+        {
+            names.push_back(reader.columnName(nameIndex));
+            if (names.back() == PathElement("x"))
+                BOOST_CHECK_EQUAL(val.atom().intVal, 7);
+            return true;
+        };
+    BOOST_CHECK(view.forEachColumn(onColumn));
+    BOOST_CHECK(names == vector<PathElement>({ PathElement("inner"),
+                    PathElement("none"), PathElement("x") }));
+}
+
+BOOST_AUTO_TEST_CASE( test_superpositions )
+{
+    Date ts1 = Date::fromSecondsSinceEpoch(1000);
+    Date ts2 = Date::fromSecondsSinceEpoch(2000);
+    ExpressionValue val = ExpressionValue::superpose
+        ({ ExpressionValue(1, ts1), ExpressionValue("two", ts2) });
+    BOOST_REQUIRE(val.isSuperposition());
+
+    ExpressionValue read = roundTrip(val);
+    BOOST_CHECK(read.isSuperposition());
+    BOOST_CHECK_EQUAL(read.extractJson(), val.extractJson());
+    BOOST_CHECK_EQUAL(read.getEffectiveTimestamp(), ts2);
+}
+
+BOOST_AUTO_TEST_CASE( test_embeddings )
+{
+    Date ts = Date::fromSecondsSinceEpoch(1000);
+
+    ExpressionValue floatsVal(std::vector<float>{ 1.5, 2.5, 3.5, 4.5 }, ts,
+                              { 2, 2 });
+
+    ValueSnapshotWriter writer;
+    // Something odd first so that the embeddings need to be aligned
+    writer.add(ExpressionValue("abc", ts));
+    writer.add(floatsVal);
+    writer.add(ExpressionValue(std::vector<double>{ 0.1, 0.2, 0.3 }, ts));
+    writer.add(ExpressionValue(std::vector<CellValue>{ "a", 1, CellValue() },
+                               ts));
+    std::string bytes = writer.finish();
+
+    ValueSnapshotReader reader(freeze(bytes));
+    BOOST_REQUIRE_EQUAL(reader.size(), 4);
+
+    ValueView floats = reader[1];
+    BOOST_REQUIRE_EQUAL(floats.kind(), ValueView::EMBEDDING);
+    BOOST_CHECK_EQUAL(floats.embeddingType(), ST_FLOAT32);
+    BOOST_CHECK(floats.embeddingShape() == DimsVector({ 2, 2 }));
+    BOOST_CHECK_EQUAL(floats.timestamp(), ts);
+    const float * data = (const float *)floats.embeddingData();
+    BOOST_REQUIRE(data);
+    BOOST_CHECK_EQUAL((uintptr_t)data % sizeof(float), 0);
+    BOOST_CHECK_EQUAL(data[3], 4.5);
+    BOOST_CHECK_EQUAL(floats.embeddingCells()[2].floatVal, 3.5);
+
+    ExpressionValue read = reader.get(1);
+    BOOST_CHECK(read.isEmbedding());
+    BOOST_CHECK_EQUAL(read.getEmbeddingType(), ST_FLOAT32);
+    BOOST_CHECK(read.getEmbeddingShape() == DimsVector({ 2, 2 }));
+    BOOST_CHECK_EQUAL(read.extractJson(), floatsVal.extractJson());
+
+    ExpressionValue doubles = reader.get(2);
+    BOOST_CHECK_EQUAL(doubles.getEmbeddingType(), ST_FLOAT64);
+    BOOST_CHECK_EQUAL(doubles.getEmbeddingCell(3)[1].toDouble(), 0.2);
+
+    ExpressionValue cells = reader.get(3);
+    BOOST_REQUIRE(cells.isEmbedding());
+    auto values = cells.getEmbeddingCell(3);
+    BOOST_CHECK_EQUAL(values[0], "a");
+    BOOST_CHECK_EQUAL(values[1], 1);
+    BOOST_CHECK(values[2].empty());
+    BOOST_CHECK(reader[3].embeddingData() == nullptr);
+
+    // The embedding keeps the snapshot alive after the reader is gone
+    ExpressionValue kept;
+    {
+        ValueSnapshotReader reader2(freeze(bytes));
+        kept = reader2.get(2);
+    }
+    BOOST_CHECK_EQUAL(kept.getEmbeddingCell(3)[2].toDouble(), 0.3);
+
+    // And it works when it's not aligned, too
+    std::string unaligned = " " + bytes;
+    ValueSnapshotReader reader3(unaligned.data() + 1, bytes.size());
+    BOOST_CHECK_EQUAL(reader3.get(2).getEmbeddingCell(3)[0].toDouble(),
+                      0.1);
+}
+
+BOOST_AUTO_TEST_CASE( test_malformed )
+{
+    MLDB_TRACE_EXCEPTIONS(false);
+
+    ValueSnapshotWriter writer;
+    StructValue row;
+    row.emplace_back(PathElement("a"), ExpressionValue("hello", Date()));
+    writer.add(ExpressionValue(std::move(row)));
+    std::string bytes = writer.finish();
+
+    // Truncated anywhere
+    for (size_t i = 0;  i < bytes.size();  ++i) {
+        BOOST_CHECK_THROW(ValueSnapshotReader(bytes.data(), i)
+                          .get(0), AnnotatedException);
+    }
+
+    // Wrong magic
+    {
+        std::string wrong = bytes;
+        wrong[0] = 'X';
+        BOOST_CHECK_THROW(ValueSnapshotReader(wrong.data(), wrong.size()),
+                          AnnotatedException);
+    }
+
+    // Unknown version
+    {
+        std::string wrong = bytes;
+        wrong[4] = 99;
+        BOOST_CHECK_THROW(ValueSnapshotReader(wrong.data(), wrong.size()),
+                          AnnotatedException);
+    }
+
+    // Column name that isn't in the dictionary
+    {
+        std::string wrong = bytes;
+        size_t pos = wrong.size() - 1 - 8 - 1 - 5 - 1 - 1;
+        BOOST_REQUIRE_EQUAL(wrong[pos], 0);
+        wrong[pos] = 5;
+        BOOST_CHECK_THROW(ValueSnapshotReader(wrong.data(), wrong.size())
+                          .get(0), AnnotatedException);
+    }
+}
@@ -9,8 +9,16 @@
 #include "base/parse_context.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/pair_description.h"
+#include "mldb/arch/simd.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
 #include <queue>
 
+#if MLDB_INTEL_ISA
+# include <emmintrin.h>
+#endif
+
 using namespace std;
 
 namespace MLDB {
@@ -47,6 +55,12 @@ TokenizeOptionsDescription()
             "underscores. For example, "
             "`tokenize('Good day world', {splitChars:' ', ngramRange:[2,3]})`"
             "will return the row `{'Good_day': 1, 'Good_day_world': 1, 'day_world': 1}`");
+    addAuto("hashBuckets", &TokenizeOptions::hashBuckets,
+            "If greater than zero, tokens (and ngrams) are hashed into this "
+            "many buckets, and the columns of the output row are the numbers "
+            "of the buckets rather than the tokens themselves.  This gives "
+            "a fixed number of features however many distinct tokens there "
+            "are, and is faster as the tokens don't need to be stored.");
 
     onUnknownField = [] (TokenizeOptions * options,
                          JsonParsingContext & context)
@@ -82,14 +96,19 @@ TokenizeOptionsDescription()
     };
 }
 
+static void checkNgramRange(int min_range, int max_range)
+{
+    if(max_range<min_range || min_range<1 || max_range<1)
+        throw MLDB::Exception("ngramRange values must be bigger than 0 "
+                "and the second value needs to be equal or bigger than the first");
+}
+
 struct NGramer {
     NGramer(int min_range, int max_range)
         : min_range(min_range), max_range(max_range),
           count(0), buffer_pos(0)
     {
-        if(max_range<min_range || min_range<1 || max_range<1)
-            throw MLDB::Exception("ngramRange values must be bigger than 0 "
-                    "and the second value needs to be equal or bigger than the first");
+        checkNgramRange(min_range, max_range);
     
         buffer.resize(max_range);
     }
@@ -325,6 +344,259 @@ bool tokenize(std::unordered_map<Utf8String, int>& bagOfWords,
 }
 
 
+namespace {
+
+/** The split characters, which must all be ASCII. */
+struct SplitChars {
+    SplitChars(const Utf8String & splitchars)
+    {
+        std::fill(isSplit, isSplit + 256, false);
+        for (char32_t c: splitchars) {
+            ExcAssertLess(c, 128);
+            if (!isSplit[c]) {
+                isSplit[c] = true;
+                chars.push_back(c);
+            }
+        }
+    }
+
+    /// Bitmap of the split characters in the 64 bytes at data
+    uint64_t block(const char * data) const
+    {
+#if MLDB_INTEL_ISA
+        // One comparison per split character; past a handful of them a
+        // table lookup per byte is faster
+        if (chars.size() <= 8) {
+            __m128i v[4];
+            __m128i found[4];
+            for (int i = 0;  i < 4;  ++i) {
+                v[i] = _mm_loadu_si128((const __m128i *)(data + 16 * i));
+                found[i] = _mm_setzero_si128();
+            }
+            for (char c: chars) {
+                __m128i cv = _mm_set1_epi8(c);
+                for (int i = 0;  i < 4;  ++i)
+                    found[i] = _mm_or_si128(found[i], _mm_cmpeq_epi8(v[i], cv));
+            }
+            return (uint64_t)(uint16_t)_mm_movemask_epi8(found[0])
+                | ((uint64_t)(uint16_t)_mm_movemask_epi8(found[1]) << 16)
+                | ((uint64_t)(uint16_t)_mm_movemask_epi8(found[2]) << 32)
+                | ((uint64_t)(uint16_t)_mm_movemask_epi8(found[3]) << 48);
+        }
+#endif
+        uint64_t result = 0;
+        for (int i = 0;  i < 64;  ++i)
+            result |= (uint64_t)isSplit[(unsigned char)data[i]] << i;
+        return result;
+    }
+
+    bool isSplit[256];
+    std::vector<char> chars;
+};
+
+/** Call onToken with each of the pieces of the text between split
+    characters, the same as tokenize_exec() does without a quote character,
+    until it returns false.
+*/
+template<typename Fn>
+void forEachPiece(const char * text, size_t length, const SplitChars & split,
+                  Fn && onToken)
+{
+    if (length == 0)
+        return;
+
+    size_t start = 0;
+    size_t numBlocks = length / 64;
+    for (size_t i = 0;  i < numBlocks;  ++i) {
+        uint64_t bits = split.block(text + i * 64);
+        while (bits) {
+            size_t pos = i * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (!onToken(text + start, pos - start))
+                return;
+            start = pos + 1;
+        }
+    }
+
+    for (size_t pos = numBlocks * 64;  pos < length;  ++pos) {
+        if (split.isSplit[(unsigned char)text[pos]]) {
+            if (!onToken(text + start, pos - start))
+                return;
+            start = pos + 1;
+        }
+    }
+
+    onToken(text + start, length - start);
+}
+
+/// Number of characters in the UTF-8 string, which is the number of bytes
+/// that don't continue a multibyte character
+size_t utf8Length(const char * str, size_t length)
+{
+    size_t result = 0;
+    for (size_t i = 0;  i < length;  ++i)
+        result += ((unsigned char)str[i] & 0xc0) != 0x80;
+    return result;
+}
+
+/** Call onToken with each non-empty token of the text that tokenize()
+    would add to its bag of words, applying the minTokenLength, offset and
+    limit options the same way.
+*/
+template<typename Fn>
+void forEachSelectedToken(const char * text, size_t length,
+                          const TokenizeOptions & options, Fn && onToken)
+{
+    SplitChars split(options.splitchar);
+    int count = 0;
+
+    auto onPiece = [&] (const char * token, size_t len) -> bool
+        {
+            if (options.minTokenLength > 0
+                && (len < (size_t)options.minTokenLength
+                    || utf8Length(token, len)
+                           < (size_t)options.minTokenLength))
+                return true;
+
+            ++count;
+            if (count <= options.offset)
+                return true;
+
+            if (len > 0)
+                onToken(token, len);
+
+            return count != options.limit + options.offset;
+        };
+
+    forEachPiece(text, length, split, onPiece);
+}
+
+/** 64 bit FNV-1a hash, which can be fed a token in several pieces. */
+struct TokenHasher {
+    uint64_t state = 14695981039346656037ULL;
+
+    void add(const char * str, size_t length)
+    {
+        for (size_t i = 0;  i < length;  ++i)
+            state = (state ^ (unsigned char)str[i]) * 1099511628211ULL;
+    }
+
+    uint64_t bucket(uint64_t numBuckets) const
+    {
+        // FNV's low bits are poorly mixed, so finish it off before
+        // taking the modulus
+        uint64_t h = state;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h % numBuckets;
+    }
+};
+
+} // file scope
+
+bool canTokenizeBytes(const TokenizeOptions & options)
+{
+    if (!options.quotechar.empty())
+        return false;
+    for (char32_t c: options.splitchar) {
+        if (c >= 128)
+            return false;
+    }
+    return true;
+}
+
+bool tokenizeBytes(const char * text, size_t length,
+                   const TokenizeOptions & options,
+                   const std::function<void (std::string_view, int)> & onToken)
+{
+    if (!canTokenizeBytes(options)
+        || options.ngramRange != std::make_pair(1, 1))
+        return false;
+
+    static thread_local std::unordered_map<std::string_view, int> counts;
+    counts.clear();
+
+    forEachSelectedToken(text, length, options,
+                         [&] (const char * token, size_t len)
+                         {
+                             ++counts[std::string_view(token, len)];
+                         });
+
+    for (auto & c: counts)
+        onToken(c.first, c.second);
+
+    return true;
+}
+
+uint64_t tokenHashBucket(const char * token, size_t length,
+                         uint64_t numBuckets)
+{
+    TokenHasher hasher;
+    hasher.add(token, length);
+    return hasher.bucket(numBuckets);
+}
+
+void tokenizeHashed(const char * text, size_t length,
+                    const TokenizeOptions & options,
+                    const std::function<void (uint64_t, int)> & onBucket)
+{
+    if (options.hashBuckets <= 0)
+        throw MLDB::Exception("hashBuckets must be greater than zero to "
+                              "hash tokens");
+    uint64_t numBuckets = options.hashBuckets;
+
+    static thread_local std::unordered_map<uint64_t, int> counts;
+    counts.clear();
+
+    if (canTokenizeBytes(options)) {
+        int minGram = options.ngramRange.first;
+        int maxGram = options.ngramRange.second;
+        checkNgramRange(minGram, maxGram);
+
+        // The last maxGram tokens, to hash the ngrams that end with each
+        // token the same way as NGramer joins them
+        std::vector<std::string_view> window(maxGram);
+        size_t numTokens = 0;
+
+        auto onToken = [&] (const char * token, size_t len)
+            {
+                window[numTokens % maxGram] = std::string_view(token, len);
+                ++numTokens;
+
+                int maxThis = std::min<size_t>(numTokens, maxGram);
+                for (int n = minGram;  n <= maxThis;  ++n) {
+                    TokenHasher hasher;
+                    for (int i = n;  i > 0;  --i) {
+                        const std::string_view & t
+                            = window[(numTokens - i) % maxGram];
+                        if (i != n)
+                            hasher.add("_", 1);
+                        hasher.add(t.data(), t.size());
+                    }
+                    ++counts[hasher.bucket(numBuckets)];
+                }
+            };
+
+        forEachSelectedToken(text, length, options, onToken);
+    }
+    else {
+        std::unordered_map<Utf8String, int> bagOfWords;
+        ParseContext pcontext("tokenize", text, length);
+        tokenize(bagOfWords, pcontext, options);
+        for (auto & w: bagOfWords) {
+            counts[tokenHashBucket(w.first.rawData(), w.first.rawLength(),
+                                   numBuckets)]
+                += w.second;
+        }
+    }
+
+    std::vector<std::pair<uint64_t, int> > sorted(counts.begin(), counts.end());
+    std::sort(sorted.begin(), sorted.end());
+    for (auto & b: sorted)
+        onBucket(b.first, b.second);
+}
+
 Utf8String token_extract(ParseContext& context,
                          int nth,
                          const TokenizeOptions & options)
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <functional>
 #include <vector>
@@ -31,6 +32,7 @@ struct TokenizeOptions {
     MLDB::CellValue value;
     int minTokenLength = 1;
     std::pair<int, int> ngramRange = { 1, 1};
+    int hashBuckets = 0;
 };
 
 /** Allow these options to be accessed and documented via the ValueDescription
@@ -51,6 +53,43 @@ bool tokenize(std::unordered_map<Utf8String, int>& bagOfWords,
               ParseContext& pcontext,
               const TokenizeOptions & options);
 
+/** Can the text be tokenized with these options by tokenizeBytes()?  This
+    is the case when all of the split characters are ASCII and there is no
+    quote character, as an ASCII character never occurs inside of a
+    multibyte UTF-8 character, so the text can be split byte by byte
+    without decoding it.
+*/
+bool canTokenizeBytes(const TokenizeOptions & options);
+
+/** Same as tokenize(), but calls onToken once for each distinct token (or
+    ngram) with its number of occurrences instead of building a map of
+    strings.  The split characters are found with SIMD instructions, and
+    the tokens are counted in a per-thread map that is reused from one call
+    to the next; each token points into the text, so nothing is allocated
+    for tokens that were already seen.  Requires canTokenizeBytes(options)
+    and ngrams of only one token; returns false if either isn't the case,
+    without calling onToken.
+*/
+bool tokenizeBytes(const char * text, size_t length,
+                   const TokenizeOptions & options,
+                   const std::function<void (std::string_view, int)> & onToken);
+
+/** Bucket of the given token (or ngram, with its tokens joined by
+    underscores) out of numBuckets.
+*/
+uint64_t tokenHashBucket(const char * token, size_t length,
+                         uint64_t numBuckets);
+
+/** Same as tokenize(), but counts the tokens by tokenHashBucket() with
+    options.hashBuckets buckets, calling onBucket once for each bucket
+    that has tokens in it, in order of bucket.  When canTokenizeBytes(),
+    the tokens and ngrams are hashed where they are in the text, so that
+    no string is ever built.
+*/
+void tokenizeHashed(const char * text, size_t length,
+                    const TokenizeOptions & options,
+                    const std::function<void (uint64_t, int)> & onBucket);
+
 Utf8String token_extract(ParseContext& context,
                          int nth,
                          const TokenizeOptions & options);
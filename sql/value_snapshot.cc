@@ -0,0 +1,764 @@
+/** value_snapshot.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Versioned binary snapshots of batches of ExpressionValues.
+*/
+
+#include "mldb/sql/value_snapshot.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/base/exc_assert.h"
+
+#include <cstring>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+const uint16_t VALUE_SNAPSHOT_VERSION = 1;
+
+namespace {
+
+const char SNAPSHOT_MAGIC[4] = { 'M', 'L', 'V', 'S' };
+constexpr size_t HEADER_BYTES = 24;
+
+bool isNumericStorage(StorageType storage)
+{
+    return storage >= ST_FLOAT32 && storage <= ST_UINT64;
+}
+
+/// Number of bytes of padding to put the given offset on an 8 byte boundary
+size_t padding(size_t offset)
+{
+    return (8 - offset % 8) % 8;
+}
+
+uint64_t zigzag(int64_t val)
+{
+    return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+}
+
+int64_t unzigzag(uint64_t val)
+{
+    return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
+
+void appendUnsigned(std::string & out, uint64_t val)
+{
+    while (val >= 128) {
+        out.push_back((char)(val & 127) | 128);
+        val >>= 7;
+    }
+    out.push_back((char)val);
+}
+
+template<typename T>
+void appendFixed(std::string & out, T val)
+{
+    out.append((const char *)&val, sizeof(val));
+}
+
+/// Append a name as it's written in the dictionary
+void appendName(std::string & out, const PathElement & name)
+{
+    // Zero is a null name; otherwise it's the length plus one
+    if (name.null()) {
+        appendUnsigned(out, 0);
+        return;
+    }
+    appendUnsigned(out, name.dataLength() + 1);
+    out.append(name.data(), name.dataLength());
+}
+
+[[noreturn]] void malformed(const char * message)
+{
+    throw AnnotatedException(400, string("Malformed value snapshot: ")
+                             + message);
+}
+
+void checkAvailable(const char * pos, const char * end, size_t n)
+{
+    if (end - pos < n)
+        malformed("truncated");
+}
+
+uint8_t readByte(const char * & pos, const char * end)
+{
+    checkAvailable(pos, end, 1);
+    return *pos++;
+}
+
+uint64_t readUnsigned(const char * & pos, const char * end)
+{
+    uint64_t result = 0;
+    for (int shift = 0;  shift < 64;  shift += 7) {
+        unsigned char c = readByte(pos, end);
+        result |= uint64_t(c & 127) << shift;
+        if (c < 128)
+            return result;
+    }
+    malformed("varint is too long");
+}
+
+template<typename T>
+T readFixed(const char * & pos, const char * end)
+{
+    T result;
+    checkAvailable(pos, end, sizeof(T));
+    std::memcpy(&result, pos, sizeof(T));
+    pos += sizeof(T);
+    return result;
+}
+
+std::string_view readBytes(const char * & pos, const char * end)
+{
+    uint64_t len = readUnsigned(pos, end);
+    checkAvailable(pos, end, len);
+    std::string_view result(pos, len);
+    pos += len;
+    return result;
+}
+
+/// Read a name as written in the dictionary
+PathElement readName(const char * & pos, const char * end)
+{
+    uint64_t len = readUnsigned(pos, end);
+    if (len == 0)
+        return PathElement();
+    len -= 1;
+    checkAvailable(pos, end, len);
+    PathElement result(pos, len);
+    pos += len;
+    return result;
+}
+
+CellValueView readCell(const char * & pos, const char * end)
+{
+    CellValueView result;
+    result.type = (CellValueView::Type)readByte(pos, end);
+
+    switch (result.type) {
+    case CellValueView::EMPTY:
+        break;
+    case CellValueView::INTEGER:
+        result.intVal = unzigzag(readUnsigned(pos, end));
+        break;
+    case CellValueView::UNSIGNED:
+        result.uintVal = readUnsigned(pos, end);
+        break;
+    case CellValueView::FLOAT:
+    case CellValueView::TIMESTAMP:
+        result.floatVal = readFixed<double>(pos, end);
+        break;
+    case CellValueView::ASCII_STRING:
+    case CellValueView::UTF8_STRING:
+    case CellValueView::BLOB:
+    case CellValueView::PATH:
+        result.bytes = readBytes(pos, end);
+        break;
+    case CellValueView::TIMEINTERVAL:
+        result.interval[0] = unzigzag(readUnsigned(pos, end));
+        result.interval[1] = unzigzag(readUnsigned(pos, end));
+        result.seconds = readFixed<double>(pos, end);
+        break;
+    default:
+        malformed("unknown cell type");
+    }
+
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* VALUE SNAPSHOT WRITER                                                     */
+/*****************************************************************************/
+
+size_t
+ValueSnapshotWriter::
+add(const ExpressionValue & val)
+{
+    offsets.push_back(values.size());
+    writeValue(val);
+    return offsets.size() - 1;
+}
+
+std::string
+ValueSnapshotWriter::
+finish()
+{
+    std::string dictionary;
+    for (auto & name: names)
+        appendName(dictionary, name);
+
+    uint64_t valuesOffset = HEADER_BYTES + dictionary.size()
+        + offsets.size() * sizeof(uint64_t);
+    valuesOffset += padding(valuesOffset);
+
+    std::string result;
+    result.reserve(valuesOffset + values.size());
+    result.append(SNAPSHOT_MAGIC, 4);
+    appendFixed(result, VALUE_SNAPSHOT_VERSION);
+    appendFixed(result, (uint16_t)0 /* flags */);
+    appendFixed(result, (uint32_t)names.size());
+    appendFixed(result, (uint32_t)offsets.size());
+    appendFixed(result, valuesOffset);
+    result += dictionary;
+    for (uint64_t offset: offsets)
+        appendFixed(result, offset);
+    result.resize(valuesOffset, '\0');
+    result += values;
+
+    clear();
+    return result;
+}
+
+void
+ValueSnapshotWriter::
+clear()
+{
+    values.clear();
+    offsets.clear();
+    names.clear();
+    nameIndexes.clear();
+}
+
+uint32_t
+ValueSnapshotWriter::
+nameIndex(const PathElement & name)
+{
+    auto it = nameIndexes.emplace(name, names.size()).first;
+    if (it->second == names.size())
+        names.push_back(name);
+    return it->second;
+}
+
+void
+ValueSnapshotWriter::
+writeCell(const CellValue & val)
+{
+    auto writeString = [&] (CellValueView::Type type, const char * data,
+                            size_t len)
+        {
+            values.push_back(type);
+            appendUnsigned(values, len);
+            values.append(data, len);
+        };
+
+    switch (val.cellType()) {
+    case CellValue::EMPTY:
+        values.push_back(CellValueView::EMPTY);
+        return;
+    case CellValue::INTEGER:
+        if (val.isInt64()) {
+            values.push_back(CellValueView::INTEGER);
+            appendUnsigned(values, zigzag(val.toInt()));
+        }
+        else {
+            values.push_back(CellValueView::UNSIGNED);
+            appendUnsigned(values, val.toUInt());
+        }
+        return;
+    case CellValue::FLOAT:
+        values.push_back(CellValueView::FLOAT);
+        appendFixed(values, val.toDouble());
+        return;
+    case CellValue::ASCII_STRING:
+        writeString(CellValueView::ASCII_STRING, val.stringChars(),
+                    val.toStringLength());
+        return;
+    case CellValue::UTF8_STRING:
+        writeString(CellValueView::UTF8_STRING, val.stringChars(),
+                    val.toStringLength());
+        return;
+    case CellValue::BLOB:
+        writeString(CellValueView::BLOB, (const char *)val.blobData(),
+                    val.blobLength());
+        return;
+    case CellValue::PATH: {
+        std::string elements;
+        Path path = val.coerceToPath();
+        appendUnsigned(elements, path.size());
+        for (size_t i = 0;  i < path.size();  ++i)
+            appendName(elements, path[i]);
+        writeString(CellValueView::PATH, elements.data(), elements.size());
+        return;
+    }
+    case CellValue::TIMESTAMP:
+        values.push_back(CellValueView::TIMESTAMP);
+        appendFixed(values, val.toTimestamp().secondsSinceEpoch());
+        return;
+    case CellValue::TIMEINTERVAL: {
+        int64_t months, days;
+        double seconds;
+        std::tie(months, days, seconds) = val.toMonthDaySecond();
+        values.push_back(CellValueView::TIMEINTERVAL);
+        appendUnsigned(values, zigzag(months));
+        appendUnsigned(values, zigzag(days));
+        appendFixed(values, seconds);
+        return;
+    }
+    case CellValue::NUM_CELL_TYPES:
+        break;
+    }
+
+    throw AnnotatedException(500, "Unknown CellValue type in snapshot");
+}
+
+void
+ValueSnapshotWriter::
+writeValue(const ExpressionValue & val)
+{
+    if (val.isAtom()) {
+        values.push_back(ValueView::ATOM);
+        writeCell(val.getAtom());
+        appendFixed(values, val.getEffectiveTimestamp().secondsSinceEpoch());
+    }
+    else if (val.isEmbedding()) {
+        StorageType storage = val.getEmbeddingType();
+        DimsVector shape = val.getEmbeddingShape();
+        size_t n = 1;
+        for (auto & d: shape)
+            n *= d;
+
+        values.push_back(ValueView::EMBEDDING);
+        values.push_back(storage);
+        appendUnsigned(values, shape.size());
+        for (auto & d: shape)
+            appendUnsigned(values, d);
+        appendFixed(values, val.getEffectiveTimestamp().secondsSinceEpoch());
+
+        if (isNumericStorage(storage)) {
+            values.resize(values.size() + padding(values.size()), '\0');
+            size_t start = values.size();
+            values.resize(start + storageBufferBytes(n, storage));
+            val.convertEmbedding(&values[start], n, storage);
+        }
+        else {
+            for (auto & c: val.getEmbeddingCell(n))
+                writeCell(c);
+        }
+    }
+    else {
+        // Rows and superpositions, which are rows whose columns have a null
+        // name
+        values.push_back(ValueView::ROW);
+        appendUnsigned(values, val.rowLength());
+        auto onColumn = [&] (const PathElement & name,
+                             const ExpressionValue & col)
+            {
+                appendUnsigned(values, nameIndex(name));
+                writeValue(col);
+                return true;
+            };
+        val.forEachColumn(onColumn);
+    }
+}
+
+
+/*****************************************************************************/
+/* CELL VALUE VIEW                                                           */
+/*****************************************************************************/
+
+CellValue
+CellValueView::
+toCell() const
+{
+    switch (type) {
+    case EMPTY:
+        return CellValue();
+    case INTEGER:
+        return intVal;
+    case UNSIGNED:
+        return uintVal;
+    case FLOAT:
+        return floatVal;
+    case ASCII_STRING:
+        return CellValue(bytes.data(), bytes.size(), STRING_IS_VALID_ASCII);
+    case UTF8_STRING:
+        return CellValue(bytes.data(), bytes.size());
+    case BLOB:
+        return CellValue::blob(bytes.data(), bytes.size());
+    case PATH: {
+        const char * pos = bytes.data();
+        const char * end = pos + bytes.size();
+        uint64_t n = readUnsigned(pos, end);
+        PathBuilder builder;
+        for (uint64_t i = 0;  i < n;  ++i)
+            builder.add(readName(pos, end));
+        return CellValue(builder.extract());
+    }
+    case TIMESTAMP:
+        return Date::fromSecondsSinceEpoch(floatVal);
+    case TIMEINTERVAL:
+        return CellValue::fromMonthDaySecond(interval[0], interval[1],
+                                             seconds);
+    }
+
+    throw AnnotatedException(500, "Unknown CellValueView type");
+}
+
+
+/*****************************************************************************/
+/* VALUE VIEW                                                                */
+/*****************************************************************************/
+
+namespace {
+
+/// Skip over the value at pos
+void skipValue(const char * & pos, const char * values, const char * end)
+{
+    switch (readByte(pos, end)) {
+    case ValueView::ATOM:
+        readCell(pos, end);
+        readFixed<double>(pos, end);
+        return;
+    case ValueView::ROW: {
+        uint64_t n = readUnsigned(pos, end);
+        for (uint64_t i = 0;  i < n;  ++i) {
+            readUnsigned(pos, end);
+            skipValue(pos, values, end);
+        }
+        return;
+    }
+    case ValueView::EMBEDDING: {
+        StorageType storage = (StorageType)readByte(pos, end);
+        uint64_t n = 1;
+        for (uint64_t i = 0, dims = readUnsigned(pos, end);  i < dims;  ++i)
+            n *= readUnsigned(pos, end);
+        readFixed<double>(pos, end);
+        if (isNumericStorage(storage)) {
+            uint64_t bytes = padding(pos - values)
+                + storageBufferBytes(n, storage);
+            checkAvailable(pos, end, bytes);
+            pos += bytes;
+        }
+        else {
+            for (uint64_t i = 0;  i < n;  ++i)
+                readCell(pos, end);
+        }
+        return;
+    }
+    }
+    malformed("unknown value kind");
+}
+
+template<typename T>
+T loadElement(const char * data, size_t i)
+{
+    T result;
+    std::memcpy(&result, data + i * sizeof(T), sizeof(T));
+    return result;
+}
+
+/// Element i of a numeric embedding
+CellValueView numericElement(const char * data, size_t i, StorageType storage)
+{
+    CellValueView result;
+    result.type = CellValueView::INTEGER;
+    switch (storage) {
+    case ST_FLOAT32:
+        result.type = CellValueView::FLOAT;
+        result.floatVal = loadElement<float>(data, i);
+        break;
+    case ST_FLOAT64:
+        result.type = CellValueView::FLOAT;
+        result.floatVal = loadElement<double>(data, i);
+        break;
+    case ST_INT8:   result.intVal = loadElement<int8_t>(data, i);  break;
+    case ST_UINT8:  result.intVal = loadElement<uint8_t>(data, i);  break;
+    case ST_INT16:  result.intVal = loadElement<int16_t>(data, i);  break;
+    case ST_UINT16: result.intVal = loadElement<uint16_t>(data, i);  break;
+    case ST_INT32:  result.intVal = loadElement<int32_t>(data, i);  break;
+    case ST_UINT32: result.intVal = loadElement<uint32_t>(data, i);  break;
+    case ST_INT64:  result.intVal = loadElement<int64_t>(data, i);  break;
+    case ST_UINT64:
+        result.type = CellValueView::UNSIGNED;
+        result.uintVal = loadElement<uint64_t>(data, i);
+        break;
+    default:
+        throw AnnotatedException(500, "Embedding storage is not numeric");
+    }
+    return result;
+}
+
+/// The header of an embedding, leaving pos at its elements
+struct EmbeddingHeader {
+    StorageType storage;
+    DimsVector shape;
+    size_t n = 1;
+    Date ts;
+
+    EmbeddingHeader(const char * & pos, const char * values,
+                    const char * end)
+    {
+        storage = (StorageType)readByte(pos, end);
+        shape.resize(readUnsigned(pos, end));
+        for (auto & d: shape) {
+            d = readUnsigned(pos, end);
+            n *= d;
+        }
+        ts = Date::fromSecondsSinceEpoch(readFixed<double>(pos, end));
+        if (isNumericStorage(storage)) {
+            pos += padding(pos - values);
+            checkAvailable(pos, end, storageBufferBytes(n, storage));
+        }
+    }
+};
+
+} // file scope
+
+ValueView::Kind
+ValueView::
+kind() const
+{
+    const char * p = pos;
+    uint8_t result = readByte(p, reader->end);
+    if (result > EMBEDDING)
+        malformed("unknown value kind");
+    return (Kind)result;
+}
+
+CellValueView
+ValueView::
+atom() const
+{
+    ExcAssertEqual(kind(), ATOM);
+    const char * p = pos + 1;
+    return readCell(p, reader->end);
+}
+
+Date
+ValueView::
+timestamp() const
+{
+    const char * p = pos + 1;
+    if (kind() == ATOM) {
+        readCell(p, reader->end);
+        return Date::fromSecondsSinceEpoch(readFixed<double>(p, reader->end));
+    }
+    ExcAssertEqual(kind(), EMBEDDING);
+    return EmbeddingHeader(p, reader->values, reader->end).ts;
+}
+
+size_t
+ValueView::
+rowLength() const
+{
+    ExcAssertEqual(kind(), ROW);
+    const char * p = pos + 1;
+    return readUnsigned(p, reader->end);
+}
+
+bool
+ValueView::
+forEachColumn(const OnColumn & onColumn) const
+{
+    ExcAssertEqual(kind(), ROW);
+    const char * p = pos + 1;
+    const char * end = reader->end;
+    uint64_t n = readUnsigned(p, end);
+    for (uint64_t i = 0;  i < n;  ++i) {
+        uint64_t nameIndex = readUnsigned(p, end);
+        if (nameIndex >= reader->names.size())
+            malformed("column name is not in the dictionary");
+        ValueView val(reader, p);
+        if (!onColumn(nameIndex, val))
+            return false;
+        skipValue(p, reader->values, end);
+    }
+    return true;
+}
+
+DimsVector
+ValueView::
+embeddingShape() const
+{
+    ExcAssertEqual(kind(), EMBEDDING);
+    const char * p = pos + 1;
+    return EmbeddingHeader(p, reader->values, reader->end).shape;
+}
+
+StorageType
+ValueView::
+embeddingType() const
+{
+    ExcAssertEqual(kind(), EMBEDDING);
+    const char * p = pos + 1;
+    return EmbeddingHeader(p, reader->values, reader->end).storage;
+}
+
+const void *
+ValueView::
+embeddingData() const
+{
+    ExcAssertEqual(kind(), EMBEDDING);
+    const char * p = pos + 1;
+    EmbeddingHeader header(p, reader->values, reader->end);
+    return isNumericStorage(header.storage) ? p : nullptr;
+}
+
+std::vector<CellValueView>
+ValueView::
+embeddingCells() const
+{
+    ExcAssertEqual(kind(), EMBEDDING);
+    const char * p = pos + 1;
+    EmbeddingHeader header(p, reader->values, reader->end);
+
+    std::vector<CellValueView> result(header.n);
+    if (isNumericStorage(header.storage)) {
+        for (size_t i = 0;  i < header.n;  ++i)
+            result[i] = numericElement(p, i, header.storage);
+    }
+    else {
+        for (auto & c: result)
+            c = readCell(p, reader->end);
+    }
+    return result;
+}
+
+ExpressionValue
+ValueView::
+toExpressionValue() const
+{
+    const char * p = pos + 1;
+    const char * end = reader->end;
+
+    switch (kind()) {
+    case ATOM: {
+        CellValue cell = readCell(p, end).toCell();
+        Date ts = Date::fromSecondsSinceEpoch(readFixed<double>(p, end));
+        return ExpressionValue(std::move(cell), ts);
+    }
+    case ROW: {
+        StructValue cols;
+        cols.reserve(rowLength());
+        auto onColumn = [&] (uint32_t nameIndex, const ValueView & val)
+            {
+                cols.emplace_back(reader->names[nameIndex],
+                                  val.toExpressionValue());
+                return true;
+            };
+        forEachColumn(onColumn);
+        return ExpressionValue(std::move(cols));
+    }
+    case EMBEDDING: {
+        EmbeddingHeader header(p, reader->values, end);
+        if (!isNumericStorage(header.storage)) {
+            std::vector<CellValue> cells(header.n);
+            for (auto & c: cells)
+                c = readCell(p, end).toCell();
+            return ExpressionValue(std::move(cells), header.ts,
+                                   std::move(header.shape));
+        }
+
+        std::shared_ptr<const void> data;
+        bool aligned = (uintptr_t)p % sizeofStorageType(header.storage) == 0;
+        if (reader->region && aligned) {
+            // Point into the region, which is kept alive by the embedding
+            data = std::shared_ptr<const void>(reader->region, p);
+        }
+        else {
+            size_t bytes = storageBufferBytes(header.n, header.storage);
+            auto copy = allocateStorageBuffer(header.n, header.storage);
+            std::memcpy(copy.get(), p, bytes);
+            data = std::move(copy);
+        }
+        return ExpressionValue::embedding(header.ts, std::move(data),
+                                          header.storage,
+                                          std::move(header.shape));
+    }
+    }
+
+    malformed("unknown value kind");
+}
+
+
+/*****************************************************************************/
+/* VALUE SNAPSHOT READER                                                     */
+/*****************************************************************************/
+
+ValueSnapshotReader::
+ValueSnapshotReader(FrozenMemoryRegion region_)
+    : region(std::make_shared<FrozenMemoryRegion>(std::move(region_))),
+      data(region->data()), length(region->length())
+{
+    init();
+}
+
+ValueSnapshotReader::
+ValueSnapshotReader(const char * data, size_t length)
+    : data(data), length(length)
+{
+    init();
+}
+
+void
+ValueSnapshotReader::
+init()
+{
+    const char * pos = data;
+    end = data + length;
+
+    checkAvailable(pos, end, HEADER_BYTES);
+    if (std::memcmp(pos, SNAPSHOT_MAGIC, 4) != 0)
+        malformed("wrong magic number");
+    pos += 4;
+
+    version_ = readFixed<uint16_t>(pos, end);
+    if (version_ != VALUE_SNAPSHOT_VERSION) {
+        throw AnnotatedException(400, "Unknown value snapshot version",
+                                 "version", version_,
+                                 "expected", VALUE_SNAPSHOT_VERSION);
+    }
+    readFixed<uint16_t>(pos, end);  // flags, which are unused
+    uint32_t numNames = readFixed<uint32_t>(pos, end);
+    numValues = readFixed<uint32_t>(pos, end);
+    uint64_t valuesOffset = readFixed<uint64_t>(pos, end);
+    if (valuesOffset > length)
+        malformed("values are past the end");
+
+    names.reserve(std::min<size_t>(numNames, length));
+    for (uint32_t i = 0;  i < numNames;  ++i)
+        names.emplace_back(readName(pos, end));
+
+    offsets = pos;
+    checkAvailable(pos, end, numValues * sizeof(uint64_t));
+    values = data + valuesOffset;
+    if (values < offsets + numValues * sizeof(uint64_t))
+        malformed("values overlap the offsets");
+}
+
+ValueView
+ValueSnapshotReader::
+operator [] (size_t index) const
+{
+    if (index >= numValues) {
+        throw AnnotatedException(400, "Value snapshot index out of range",
+                                 "index", index,
+                                 "size", numValues);
+    }
+    uint64_t offset;
+    std::memcpy(&offset, offsets + index * sizeof(uint64_t), sizeof(offset));
+    if (offset >= end - values)
+        malformed("value is past the end");
+    return ValueView(this, values + offset);
+}
+
+const PathElement &
+ValueSnapshotReader::
+columnName(uint32_t index) const
+{
+    if (index >= names.size()) {
+        throw AnnotatedException(400, "Column name index out of range",
+                                 "index", index,
+                                 "size", names.size());
+    }
+    return names[index];
+}
+
+} // namespace MLDB
@@ -0,0 +1,256 @@
+/** value_snapshot.h                                                -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Versioned binary snapshots of batches of ExpressionValues, which can be
+    read in place without copying their strings.  This is the common format
+    for values that are spilled, cached or sent to another process.
+*/
+
+#pragma once
+
+#include "mldb/sql/expression_value.h"
+#include "mldb/block/memory_region.h"
+#include <string_view>
+#include <unordered_map>
+
+
+namespace MLDB {
+
+struct ValueSnapshotReader;
+
+/// Version of the snapshot format written by ValueSnapshotWriter
+extern const uint16_t VALUE_SNAPSHOT_VERSION;
+
+
+/*****************************************************************************/
+/* VALUE SNAPSHOT WRITER                                                     */
+/*****************************************************************************/
+
+/** Writes a batch of values into a snapshot, which is laid out as:
+
+    - a 24 byte header: the magic "MLVS", the version and flags (16 bits
+      each), the number of column names and of values (32 bits each) and
+      the offset of the values from the start of the snapshot (64 bits);
+    - the dictionary of column names, each of which is its length plus one
+      as a varint followed by its UTF-8 bytes, with zero being the null
+      name;
+    - the offset of each value from the start of the values, as 64 bit
+      integers;
+    - the values, starting on an 8 byte boundary.
+
+    All integers are little endian.  Each column name is written once per
+    batch, and the columns of rows refer to it by its index in the
+    dictionary.  Numeric embeddings are written as an array of their
+    storage type on an 8 byte boundary, so that they can be used in place.
+*/
+
+struct ValueSnapshotWriter {
+    /// Add a value to the batch, returning its index
+    size_t add(const ExpressionValue & val);
+
+    /// Number of values in the batch
+    size_t size() const
+    {
+        return offsets.size();
+    }
+
+    /// Return the snapshot of the batch, and start a new one
+    std::string finish();
+
+    /// Forget the values added so far
+    void clear();
+
+private:
+    std::string values;
+    std::vector<uint64_t> offsets;
+    std::vector<PathElement> names;
+    std::unordered_map<PathElement, uint32_t> nameIndexes;
+
+    uint32_t nameIndex(const PathElement & name);
+    void writeCell(const CellValue & val);
+    void writeValue(const ExpressionValue & val);
+};
+
+
+/*****************************************************************************/
+/* CELL VALUE VIEW                                                           */
+/*****************************************************************************/
+
+/** An atom within a snapshot.  The bytes of strings, blobs and paths point
+    into the snapshot, which must outlive the view.
+*/
+
+struct CellValueView {
+    enum Type : uint8_t {
+        EMPTY,
+        INTEGER,
+        UNSIGNED,
+        FLOAT,
+        ASCII_STRING,
+        UTF8_STRING,
+        BLOB,
+        PATH,
+        TIMESTAMP,
+        TIMEINTERVAL
+    };
+
+    Type type = EMPTY;
+
+    union {
+        int64_t intVal = 0;
+        uint64_t uintVal;
+        double floatVal;      ///< Also the seconds of a timestamp
+        int32_t interval[2];  ///< Months and days of an interval
+    };
+
+    double seconds = 0;       ///< Seconds of an interval
+
+    /** For strings and blobs, their bytes.  For paths, their encoded
+        elements, which are the number of elements as a varint followed by
+        each element as it's written in the dictionary.
+    */
+    std::string_view bytes;
+
+    bool empty() const
+    {
+        return type == EMPTY;
+    }
+
+    /// Return the value as a CellValue, copying its bytes
+    CellValue toCell() const;
+};
+
+
+/*****************************************************************************/
+/* VALUE VIEW                                                                */
+/*****************************************************************************/
+
+/** A value within a snapshot, which is decoded as it's accessed.  The
+    reader must outlive the view.
+*/
+
+struct ValueView {
+    enum Kind : uint8_t {
+        ATOM,
+        ROW,
+        EMBEDDING
+    };
+
+    ValueView(const ValueSnapshotReader * reader = nullptr,
+              const char * pos = nullptr)
+        : reader(reader), pos(pos)
+    {
+    }
+
+    Kind kind() const;
+
+    /// The value of an atom
+    CellValueView atom() const;
+
+    /// The timestamp of an atom or embedding
+    Date timestamp() const;
+
+    /// The number of columns of a row
+    size_t rowLength() const;
+
+    typedef std::function<bool (uint32_t nameIndex, const ValueView & val)>
+        OnColumn;
+
+    /** Call onColumn for each column of a row, with the index of its name
+        in the dictionary of the snapshot.  Stops and returns false if
+        onColumn returns false.
+    */
+    bool forEachColumn(const OnColumn & onColumn) const;
+
+    /// The shape of an embedding
+    DimsVector embeddingShape() const;
+
+    /// The storage type of an embedding
+    StorageType embeddingType() const;
+
+    /** The elements of an embedding whose storage type is numeric, in
+        place.  These are aligned for their type as long as the snapshot
+        is aligned on 8 bytes.  Returns nullptr for other embeddings.
+    */
+    const void * embeddingData() const;
+
+    /// The elements of an embedding, of any storage type
+    std::vector<CellValueView> embeddingCells() const;
+
+    /** Return the value as an ExpressionValue.  The elements of numeric
+        embeddings are used in place if the snapshot is held in a frozen
+        memory region; everything else is copied.
+    */
+    ExpressionValue toExpressionValue() const;
+
+private:
+    friend struct ValueSnapshotReader;
+    const ValueSnapshotReader * reader;
+    const char * pos;
+};
+
+
+/*****************************************************************************/
+/* VALUE SNAPSHOT READER                                                     */
+/*****************************************************************************/
+
+/** Reads the values of a snapshot written by a ValueSnapshotWriter.  The
+    header and dictionary are checked and decoded when it's constructed;
+    the values are decoded as they are accessed.  Malformed or truncated
+    snapshots throw a 400 error.
+*/
+
+struct ValueSnapshotReader {
+    /// Read from the region, which is kept alive by the reader
+    ValueSnapshotReader(FrozenMemoryRegion region);
+
+    /// Read from the given memory, which must outlive the reader
+    ValueSnapshotReader(const char * data, size_t length);
+
+    /// Version of the format of the snapshot
+    uint16_t version() const
+    {
+        return version_;
+    }
+
+    /// Number of values in the snapshot
+    size_t size() const
+    {
+        return numValues;
+    }
+
+    /// Return a view of the value with the given index
+    ValueView operator [] (size_t index) const;
+
+    /// Return the value with the given index as an ExpressionValue
+    ExpressionValue get(size_t index) const
+    {
+        return operator [] (index).toExpressionValue();
+    }
+
+    /// The dictionary of column names
+    const std::vector<PathElement> & columnNames() const
+    {
+        return names;
+    }
+
+    const PathElement & columnName(uint32_t index) const;
+
+private:
+    friend struct ValueView;
+
+    /// Keeps the region alive for the embeddings that point into it
+    std::shared_ptr<const FrozenMemoryRegion> region;
+    const char * data;
+    size_t length;
+    uint16_t version_;
+    size_t numValues;
+    std::vector<PathElement> names;
+    const char * offsets;
+    const char * values;
+    const char * end;
+
+    void init();
+};
+
+} // namespace MLDB
@@ -85,7 +85,50 @@ class Mldb1119(MldbUnitTest):
         # no match
         assert_val(js_res, "doc4", "word2vec.0", 0)
 
-    
+
+    def test_all_aggregators(self):
+        mldb.put("/v1/functions/pool_all", {
+            "type": "pooling",
+            "params": {
+                "embeddingDataset": "wordEmbedding",
+                "aggregators": ["avg", "min", "max", "sum"]
+            }
+        })
+
+        # words are pooled once each, whatever their count
+        res = mldb.query("""
+            select pool_all({words: {allo: 1, mon: 3, patate: 1}})[embedding]
+            as e
+        """)
+        self.assertEqual(len(res[1]), 9)
+        for got, exp in zip(res[1][1:],
+                            [0.5, 0.475, 0.2, 0, 0.8, 0.95, 1.0, 0.95]):
+            self.assertAlmostEqual(got, exp, places=5)
+
+    def test_missing_values(self):
+        # Null values are skipped, as in the SQL aggregators
+        ds = mldb.create_dataset({
+            'type': 'sparse.mutable',
+            'id': 'sparseEmbedding'
+        })
+        now = datetime.datetime.strptime('Jun 1 2005  1:33PM', '%b %d %Y %I:%M%p')
+        ds.record_row("allo", [["x", 1, now], ["y", 2, now]])
+        ds.record_row("mon", [["x", 3, now]])
+        ds.commit()
+
+        mldb.put("/v1/functions/pool_sparse", {
+            "type": "pooling",
+            "params": {
+                "embeddingDataset": "sparseEmbedding",
+                "aggregators": ["avg", "sum"]
+            }
+        })
+
+        res = mldb.query("""
+            select pool_sparse({words: {allo: 1, mon: 1}})[embedding] as e
+        """)
+        self.assertEqual(res[1][1:], [2, 2, 4, 2])
+
     # MLDB-1733
     def test_returns_null_if_null_input(self):
         mldb.put("/v1/procedures/megatron", {
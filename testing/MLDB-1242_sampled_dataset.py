@@ -116,6 +116,34 @@ class SampledDatasetTest(unittest.TestCase):
         rez2 = mldb.get("/v1/query", q="select * from sample(toy, {rows: 1})")
         self.assertNotEqual(rez.json()[0], rez2.json()[0])
 
+    def test_rows_are_distinct(self):
+        for fraction in [0.1, 0.9]:
+            rez = mldb.query(
+                "select rowName() from sample(toy, {fraction: %f, seed: 3})"
+                % fraction)
+            names = [r[0] for r in rez[1:]]
+            self.assertEqual(len(names), int(500 * fraction))
+            self.assertEqual(len(set(names)), len(names))
+
+        rez = mldb.query("select count(*) from sample(toy, {rows: 500})")
+        self.assertEqual(rez[1][1], 500)
+
+    def test_sampled_column(self):
+        mldb.put("/v1/datasets/sampled_col", {
+            "type": "sampled",
+            "params": {
+                "dataset": "toy",
+                "rows": 50,
+                "seed": 7
+            }
+        })
+        rez = mldb.query(
+            "select count(*) from transpose(sampled_col)")
+        self.assertEqual(rez[1][1], 1)
+        rez = mldb.query(
+            "select count(feat1) from sampled_col")
+        self.assertEqual(rez[1][1], 50)
+
     def test_default_options(self):
         rez = mldb.get(
             "/v1/query",
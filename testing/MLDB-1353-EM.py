@@ -88,4 +88,36 @@ result = mldb.query("select em_function({{* EXCLUDING(class)} as embedding}) fro
 for i in range(1, 151):
 	assert expected[i] == result[i]
 
+# with diagonal covariance matrices
+
+mldb.put('/v1/procedures/em_train_iris_diag', {
+    'type' : 'gaussianclustering.train',
+    'params' : {
+        'trainingData' : 'select * EXCLUDING(class) from iris',
+        'outputDataset' : 'iris_clusters_diag',
+        'centroidsDataset' : 'iris_centroids_diag',
+        'numClusters' : 3,
+        'diagonalCovariance' : True,
+        'modelFileUrl' : "file://tmp/MLDB-1353-diag.gs",
+        'functionName' : 'em_function_diag',
+        "runOnCreation": True
+    }
+})
+
+res = mldb.query("""
+    select count(*) from iris_clusters_diag group by cluster
+""")
+assert len(res) == 4
+assert sum(r[1] for r in res[1:]) == 150
+
+# off-diagonal entries of the covariance matrices are all zero
+res = mldb.query("select c01, c02, c04, c11 from iris_centroids_diag")
+for r in res[1:]:
+    assert r[1:] == [0, 0, 0, 0]
+
+expected = mldb.query("select * from iris_clusters_diag order by rowName()")
+result = mldb.query("select em_function_diag({{* EXCLUDING(class)} as embedding}) from iris order by rowName()")
+for i in range(1, 151):
+	assert expected[i] == result[i]
+
 request.set_return("success")
@@ -97,3 +97,66 @@ BOOST_AUTO_TEST_CASE( test_multithreaded_insert_ww )
     config.favor = TF_FAVOR_WRITES;
     testMtInsert(config);
 }
+
+BOOST_AUTO_TEST_CASE( test_read_while_inserting )
+{
+    // Writes that are only readable after a commit don't change the
+    // version that readers see, so readers running at the same time as
+    // the writers always see the same (empty) dataset.
+    MldbServer server;
+    
+    server.init();
+
+    MutableSparseMatrixDatasetConfig config;
+    config.consistencyLevel = WT_READ_AFTER_COMMIT;
+
+    PolyConfig pconfig;
+    pconfig.params = config;
+    MutableSparseMatrixDataset dataset(&server, pconfig, nullptr);
+
+    constexpr int niter = 1000;
+    constexpr int nthreads = 8;
+
+    std::atomic<bool> finished(false);
+    std::atomic<size_t> numReads(0), badReads(0);
+
+    auto readThread = [&] ()
+        {
+            auto matrix = dataset.getMatrixView();
+            while (!finished) {
+                if (matrix->getRowCount() != 0)
+                    ++badReads;
+                ++numReads;
+            }
+        };
+
+    auto insertThread = [&] (int thread)
+        {
+            for (unsigned i = 0;  i < niter;  ++i) {
+                std::vector<std::tuple<ColumnPath, CellValue, Date> > vals
+                    = { std::make_tuple(PathElement("x"), CellValue(i),
+                                        Date::now()) };
+                dataset.recordRow(PathElement(thread * niter + i), vals);
+            }
+        };
+
+    std::vector<std::thread> readers, writers;
+    for (unsigned i = 0;  i < 2;  ++i)
+        readers.emplace_back(readThread);
+    for (unsigned i = 0;  i < nthreads;  ++i)
+        writers.emplace_back(insertThread, i);
+
+    for (auto & t: writers)
+        t.join();
+    finished = true;
+    for (auto & t: readers)
+        t.join();
+
+    cerr << "did " << numReads << " reads while inserting" << endl;
+
+    BOOST_CHECK_EQUAL(badReads.load(), 0);
+
+    dataset.commit();
+    BOOST_CHECK_EQUAL(dataset.getMatrixView()->getRowCount(),
+                      nthreads * niter);
+}
@@ -90,5 +90,35 @@ class Mldb1507Test(MldbUnitTest):  # noqa
         with self.assertRaisesRegex(ResponseException, msg):
             mldb.query("SELECT * FROM test_groupby_select_star GROUP BY colA")
 
+    def test_groupby_many_groups(self):
+        # Enough rows and groups that the partial aggregates are merged in
+        # parallel; the groups must still be merged and come out in order
+        ds = mldb.create_dataset({
+            'id' : 'test_groupby_many_groups',
+            'type' : 'tabular'
+        })
+        expected = {}
+        for i in range(30000):
+            key = i % 3001 if i % 2 else 'k%d' % (i % 1009)
+            ds.record_row('row%d' % i, [['key', key, 0], ['v', i, 0]])
+            count, total = expected.get(key, (0, 0))
+            expected[key] = (count + 1, total + i)
+        ds.commit()
+
+        rows = mldb.get('/v1/query', format='aos', rowNames=0, q="""
+            SELECT key, count(*) AS c, sum(v) AS s
+            FROM test_groupby_many_groups
+            GROUP BY key
+        """).json()
+        self.assertEqual(len(rows), len(expected))
+
+        keys = [r['key'] for r in rows]
+        numbers = sorted(k for k in expected if not isinstance(k, str))
+        strings = sorted(k for k in expected if isinstance(k, str))
+        self.assertEqual(keys, numbers + strings)
+
+        for r in rows:
+            self.assertEqual((r['c'], r['s']), expected[r['key']])
+
 
 mldb.run_tests()
@@ -30,5 +30,25 @@ class Mldb1706Test(MldbUnitTest):  # noqa
             [["_rowName","horizontal_max( {TIMESTAMP 1, TIMESTAMP 2} )"],[
               "result","1970-01-01T00:00:02Z"]])
 
+    def test_embedding_matches_row(self):
+        # embeddings are reduced directly over their storage; the result
+        # must be the same as for the equivalent row
+        for fn in ['count', 'sum', 'avg', 'min', 'max']:
+            emb = mldb.query(
+                "select horizontal_{}([1.5, -2.5, 3.0, 0.25, -0.0]) as r"
+                .format(fn))
+            row = mldb.query(
+                "select horizontal_{}({{a: 1.5, b: -2.5, c: 3.0, d: 0.25, "
+                "e: -0.0}}) as r".format(fn))
+            self.assertEqual(emb[1][1], row[1][1])
+
+        vals = [i % 37 - 18.5 for i in range(1000)]
+        wide = '[' + ', '.join(str(v) for v in vals) + ']'
+        for fn, expected in [('count', len(vals)), ('sum', sum(vals)),
+                             ('min', min(vals)), ('max', max(vals))]:
+            res = mldb.query(
+                "select horizontal_{}({}) as r".format(fn, wide))
+            self.assertEqual(res[1][1], expected)
+
 if __name__ == '__main__':
     mldb.run_tests()
@@ -11,6 +11,8 @@
 #include <boost/test/unit_test.hpp>
 #include "mldb/plugins/tabular/frozen_column.h"
 #include "mldb/plugins/tabular/tabular_dataset_column.h"
+#include "mldb/plugins/tabular/zone_map.h"
+#include "mldb/block/zip_serializer.h"
 #include "mldb/server/mldb_server.h"
 #include "mldb/arch/timers.h"
 #include "mldb/types/set_description.h"
@@ -46,6 +48,85 @@ freezeAndTest(const std::vector<CellValue> & cells, size_t offset = 0)
         BOOST_REQUIRE_EQUAL(frozen->get(i + offset), cells[i]);
     }
 
+    // The batch getters must agree with get(), including for the rows
+    // before and after the ones stored in the column
+    {
+        uint32_t end = offset + cells.size() + 3;
+        std::vector<CellValue> range(end);
+        frozen->getRange(0, end, range.data());
+
+        std::vector<uint32_t> selection;
+        for (uint32_t i = 0;  i < end;  i += 3)
+            selection.push_back(i);
+        std::vector<CellValue> selected(selection.size());
+        frozen->getSelection(selection.data(), selection.size(),
+                             selected.data());
+
+        for (uint32_t i = 0;  i < end;  ++i) {
+            BOOST_REQUIRE_EQUAL(range[i], frozen->get(i));
+        }
+        for (size_t i = 0;  i < selection.size();  ++i) {
+            BOOST_REQUIRE_EQUAL(selected[i], frozen->get(selection[i]));
+        }
+
+        // Sub-range in the middle
+        if (cells.size() > 2) {
+            std::vector<CellValue> sub(cells.size() - 2);
+            frozen->getRange(offset + 1, offset + cells.size() - 1, sub.data());
+            for (size_t i = 0;  i < sub.size();  ++i) {
+                BOOST_REQUIRE_EQUAL(sub[i], cells[i + 1]);
+            }
+        }
+
+        std::vector<double> doubles(end);
+        if (frozen->getRangeDouble(0, end, doubles.data())) {
+            for (uint32_t i = 0;  i < end;  ++i) {
+                if (range[i].empty())
+                    BOOST_CHECK(std::isnan(doubles[i]));
+                else if (range[i].isTimestamp())
+                    BOOST_CHECK_EQUAL(doubles[i], range[i].toTimestamp()
+                                      .secondsSinceEpoch());
+                else
+                    BOOST_CHECK_EQUAL(doubles[i], range[i].toDouble());
+            }
+        }
+        else {
+            bool allNumeric = true;
+            for (auto & v: range)
+                allNumeric = allNumeric
+                    && (v.empty() || v.isNumber() || v.isTimestamp());
+            BOOST_CHECK(!allNumeric);
+        }
+
+        std::vector<int64_t> ints(end);
+        if (frozen->getRangeInt64(0, end, ints.data(), -12345)) {
+            for (uint32_t i = 0;  i < end;  ++i) {
+                if (range[i].empty())
+                    BOOST_CHECK_EQUAL(ints[i], -12345);
+                else
+                    BOOST_CHECK_EQUAL(ints[i], range[i].toInt());
+            }
+        }
+
+        // Presence must agree with the values, over the whole range and
+        // over one that starts at an unaligned row
+        for (uint32_t first: { 0U, (uint32_t)offset + 1 }) {
+            if (first > end)
+                continue;
+            std::vector<uint64_t> present((end - first + 63) / 64);
+            frozen->getPresence(first, end, present.data());
+            size_t numPresent = 0;
+            for (uint32_t i = first;  i < end;  ++i) {
+                bool isPresent
+                    = (present[(i - first) / 64] >> ((i - first) % 64)) & 1;
+                BOOST_REQUIRE_EQUAL(isPresent, !range[i].empty());
+                BOOST_REQUIRE_EQUAL(frozen->isNull(i), range[i].empty());
+                numPresent += isPresent;
+            }
+            BOOST_CHECK_EQUAL(frozen->countNonNull(first, end), numPresent);
+        }
+    }
+
     {
         std::vector<CellValue> outVals(cells.size());
         std::set<int64_t> done;
@@ -285,7 +366,8 @@ BOOST_AUTO_TEST_CASE( test_big_pos_neg_range )
     freezeAndTest(vals, 1020 /* offset */);
 }
 
-// Full range and nulls.  Not enough 64 bit integers to represent all values.
+// Full range and nulls.  There are not enough 64 bit integers to reserve
+// one for null, so it relies on the presence bitmap.
 BOOST_AUTO_TEST_CASE( test_big_pos_neg_range_and_nulls )
 {
     std::vector<CellValue> vals;
@@ -297,7 +379,112 @@ BOOST_AUTO_TEST_CASE( test_big_pos_neg_range_and_nulls )
     }
     vals.emplace_back();
 
+    auto frozen = freezeAndTest(vals);
+
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                   "MLDB::IntegerFrozenColumn");
+
+    freezeAndTest(vals, 1020 /* offset */);
+}
+
+// Integers with nulls between them, not just at the end
+BOOST_AUTO_TEST_CASE( test_frozen_ints_with_gaps )
+{
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 200;  ++i) {
+        vals.push_back(i % 2 ? CellValue(i) : CellValue());
+    }
+    vals[0] = 1000;
+
+    auto frozen = freezeAndTest(vals);
+
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::IntegerFrozenColumn");
+
+    freezeAndTest(vals, 1020 /* offset */);
+}
+
+// Long runs of the same value, including a run of nulls
+BOOST_AUTO_TEST_CASE( test_frozen_ints_runs )
+{
+    std::vector<CellValue> vals;
+    for (int i = 0;  i < 1000;  ++i) {
+        if (i >= 300 && i < 400)
+            vals.emplace_back();
+        else vals.push_back(i / 100 - 5);
+    }
+
+    auto frozen = freezeAndTest(vals);
+
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::RunLengthFrozenColumn");
+    BOOST_CHECK_LT(frozen->memusage(), 1000);
+
+    freezeAndTest(vals, 1020 /* offset */);
+}
+
+// Sorted integers with small, irregular gaps
+BOOST_AUTO_TEST_CASE( test_frozen_ints_sorted )
+{
+    std::vector<CellValue> vals;
+    for (int64_t i = 0;  i < 1000;  ++i) {
+        vals.push_back(1000000000 + i * 7 + i % 3);
+    }
+
+    auto frozen = freezeAndTest(vals);
+
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::DeltaFrozenColumn");
+    BOOST_CHECK_LT(frozen->memusage(), 1000);
+
+    freezeAndTest(vals, 1020 /* offset */);
+
+    // Not a multiple of the block size, and a single row
+    vals.resize(65);
+    freezeAndTest(vals);
+    vals.resize(1);
+    freezeAndTest(vals);
+}
+
+// Sorted integers with some nulls, which are stored as repeats of the
+// previous value
+BOOST_AUTO_TEST_CASE( test_frozen_ints_sorted_with_nulls )
+{
+    std::vector<CellValue> vals;
+    for (int64_t i = 0;  i < 1000;  ++i) {
+        if (i % 10 == 3)
+            vals.emplace_back();
+        else vals.push_back(1000000000 + i * 7 + i % 3);
+    }
+
+    auto frozen = freezeAndTest(vals);
+
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::DeltaFrozenColumn");
+    BOOST_CHECK_EQUAL(frozen->nonNullRowCount(), 900);
+
+    freezeAndTest(vals, 1020 /* offset */);
+
+    // Leading and trailing nulls
+    vals[0] = vals[1] = vals[999] = CellValue();
     freezeAndTest(vals);
+}
+
+// Mostly nulls, so that the presence bitmap is sparse
+BOOST_AUTO_TEST_CASE( test_frozen_ints_mostly_nulls )
+{
+    std::vector<CellValue> vals(100000);
+    for (int64_t i = 0;  i < 100000;  i += 997) {
+        vals[i] = i;
+    }
+    // A dense stretch, so that more than one kind of container is used
+    for (int64_t i = 70000;  i < 75000;  ++i) {
+        vals[i] = i % 7;
+    }
+
+    auto frozen = freezeAndTest(vals);
+    BOOST_CHECK_EQUAL(frozen->countNonNull(0, 100000),
+                      frozen->nonNullRowCount());
 
     freezeAndTest(vals, 1020 /* offset */);
 }
@@ -410,3 +597,191 @@ BOOST_AUTO_TEST_CASE( test_timestamp_basics_null )
 
     freezeAndTest(vals, 1020 /* offset */);
 }
+
+// Sorted, whole second timestamps should only take a few bits per row
+BOOST_AUTO_TEST_CASE( test_timestamp_sorted )
+{
+    std::vector<CellValue> vals;
+
+    for (int64_t i = 0;  i < 1000;  ++i) {
+        vals.push_back(Date::fromSecondsSinceEpoch(1500000000 + i * 60));
+    }
+
+    auto frozen = freezeAndTest(vals);
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::TimestampFrozenColumn");
+    BOOST_CHECK_LT(frozen->memusage(), 1000);
+
+    freezeAndTest(vals, 1020 /* offset */);
+}
+
+BOOST_AUTO_TEST_CASE( test_string_basics )
+{
+    std::vector<CellValue> vals;
+
+    for (int64_t i = 0;  i < 1000;  ++i) {
+        vals.push_back("http://www.example.com/path/to/page/"
+                       + std::to_string(i % 300) + "?q=" + std::to_string(i % 7));
+    }
+
+    auto frozen = freezeAndTest(vals);
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::CompressedStringFrozenColumn");
+
+    freezeAndTest(vals, 1020 /* offset */);
+}
+
+BOOST_AUTO_TEST_CASE( test_string_nulls_and_utf8 )
+{
+    std::vector<CellValue> vals;
+    vals.emplace_back();
+
+    for (int64_t i = 0;  i < 100;  ++i) {
+        vals.push_back("prefix");
+        vals.emplace_back();
+        vals.push_back(Utf8String("prefixé" + std::to_string(i)));
+        vals.push_back("");
+        vals.push_back(Utf8String("préfixe " + std::to_string(i * 17)));
+    }
+    vals.emplace_back();
+
+    auto frozen = freezeAndTest(vals);
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::CompressedStringFrozenColumn");
+
+    freezeAndTest(vals, 1020 /* offset */);
+}
+
+BOOST_AUTO_TEST_CASE( test_string_long_values )
+{
+    std::vector<CellValue> vals;
+
+    // Long, mostly distinct values with long shared prefixes; these are
+    // the kind that dominate memory in URL and user agent columns
+    std::string prefix(5000, 'x');
+    for (int64_t i = 0;  i < 2000;  ++i) {
+        vals.push_back(prefix + std::to_string(i * 7919 % 2000));
+    }
+
+    auto frozen = freezeAndTest(vals);
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::CompressedStringFrozenColumn");
+    BOOST_CHECK_LT(frozen->memusage(), prefix.size() * 400);
+}
+
+BOOST_AUTO_TEST_CASE( test_zone_map_numeric )
+{
+    TabularDatasetColumn col;
+    col.add(0, 10);
+    col.add(2, 3.5);
+    col.add(3, 42);
+
+    ColumnZoneMap zm = ColumnZoneMap::fromColumn(col, 5);
+    BOOST_CHECK_EQUAL(zm.numNonNull, 3);
+    BOOST_CHECK_EQUAL(zm.numNulls, 2);
+    BOOST_CHECK(zm.hasRange);
+    BOOST_CHECK_EQUAL(zm.minValue, 3.5);
+    BOOST_CHECK_EQUAL(zm.maxValue, 42);
+    BOOST_CHECK(zm.stringBloom.empty());
+
+    BOOST_CHECK(zm.mayMatch(">", 41));
+    BOOST_CHECK(!zm.mayMatch(">", 42));
+    BOOST_CHECK(zm.mayMatch(">=", 42));
+    BOOST_CHECK(!zm.mayMatch("<", 3.5));
+    BOOST_CHECK(zm.mayMatch("<=", 3.5));
+    BOOST_CHECK(!zm.mayMatch("=", 100));
+    BOOST_CHECK(zm.mayMatch("=", 10));
+
+    // Strings sort after numbers, and nothing compares true with null
+    BOOST_CHECK(!zm.mayMatch(">", "hello"));
+    BOOST_CHECK(zm.mayMatch("<", "hello"));
+    BOOST_CHECK(!zm.mayMatch("<", CellValue()));
+
+    // No values at all means nothing can match
+    TabularDatasetColumn empty;
+    empty.add(0, CellValue());
+    ColumnZoneMap zmEmpty = ColumnZoneMap::fromColumn(empty, 10);
+    BOOST_CHECK_EQUAL(zmEmpty.numNulls, 10);
+    BOOST_CHECK(!zmEmpty.mayMatch("<", 1000));
+    BOOST_CHECK(!zmEmpty.mayMatch("=", "x"));
+}
+
+BOOST_AUTO_TEST_CASE( test_zone_map_strings )
+{
+    TabularDatasetColumn col;
+    std::vector<std::string> vals;
+    for (unsigned i = 0;  i < 100;  ++i) {
+        vals.push_back("value " + std::to_string(i * 2));
+        col.add(i, vals.back());
+    }
+
+    ColumnZoneMap zm = ColumnZoneMap::fromColumn(col, 100);
+    BOOST_CHECK(zm.hasRange);
+    BOOST_CHECK_EQUAL(zm.minValue, "value 0");
+    BOOST_CHECK_EQUAL(zm.maxValue, "value 98");
+    BOOST_CHECK(!zm.stringBloom.empty());
+
+    // No false negatives
+    for (auto & v: vals)
+        BOOST_CHECK(zm.mayMatch("=", v));
+
+    // Values within the range but not present should mostly be rejected
+    int numFalsePositives = 0;
+    for (unsigned i = 0;  i < 100;  ++i)
+        numFalsePositives += zm.mayContain("value " + std::to_string(i * 2 + 1));
+    cerr << numFalsePositives << " bloom false positives" << endl;
+    BOOST_CHECK_LT(numFalsePositives, 20);
+
+    // Round-trip through JSON, which is how it's persisted
+    ColumnZoneMap zm2 = jsonDecodeStr<ColumnZoneMap>(jsonEncodeStr(zm));
+    BOOST_CHECK_EQUAL(zm2.minValue, zm.minValue);
+    BOOST_CHECK_EQUAL(zm2.maxValue, zm.maxValue);
+    BOOST_CHECK(zm2.stringBloom == zm.stringBloom);
+    for (auto & v: vals)
+        BOOST_CHECK(zm2.mayMatch("=", v));
+}
+
+BOOST_AUTO_TEST_CASE( test_frozen_column_reconstitute )
+{
+    std::vector<std::vector<CellValue> > inputs(6);
+    for (int64_t i = 0;  i < 1000;  ++i) {
+        inputs[0].push_back(i * 3 - 500);
+        inputs[1].push_back(i % 3 == 0 ? CellValue() : CellValue(i / 7.0));
+        inputs[2].push_back(Date::fromSecondsSinceEpoch(i * 86400.5));
+        inputs[3].push_back("string " + std::to_string(i % 100));
+        inputs[4].push_back(i % 2 ? CellValue(i) : CellValue("mixed"));
+        inputs[5].push_back(i % 50 == 0 ? CellValue(i) : CellValue());
+    }
+
+    int numInputs = inputs.size();
+    std::string filename = "tmp/MLDB-1742-reconstitute.zip";
+    MemorySerializer memSerializer;
+    std::vector<std::shared_ptr<FrozenColumn> > frozen;
+
+    {
+        ZipStructuredSerializer serializer(filename);
+        for (int i = 0;  i < numInputs;  ++i) {
+            TabularDatasetColumn col;
+            for (size_t j = 0;  j < inputs[i].size();  ++j)
+                col.add(j + 10, inputs[i][j]);
+            frozen.emplace_back(col.freeze(memSerializer,
+                                           ColumnFreezeParameters()));
+            frozen.back()->serialize(*serializer.newStructure(i));
+        }
+    }
+
+    ZipStructuredReconstituter reconstituter(Url("file://" + filename));
+
+    for (int i = 0;  i < numInputs;  ++i) {
+        auto loaded = FrozenColumn::reconstitute
+            (*reconstituter.getStructure(i));
+        cerr << "reconstituted " << MLDB::type_name(*loaded) << endl;
+        BOOST_CHECK_EQUAL(loaded->format(), frozen[i]->format());
+        BOOST_CHECK_EQUAL(loaded->size(), frozen[i]->size());
+        BOOST_CHECK_EQUAL(loaded->nonNullRowCount(),
+                          frozen[i]->nonNullRowCount());
+        for (size_t j = 0;  j < inputs[i].size() + 20;  ++j) {
+            BOOST_REQUIRE_EQUAL(loaded->get(j), frozen[i]->get(j));
+        }
+    }
+}
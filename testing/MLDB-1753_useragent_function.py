@@ -101,6 +101,30 @@ class MLDB1753UseragentFunction(MldbUnitTest):  # noqa
             [["_rowName","browser.family","browser.version","device.brand","device.model","isSpider","os.family","os.version"],
             ["result",None,None,None,None,None,None,None]])
 
+    def test_cached_by_default(self):
+        ua = 'Mozilla/5.0 (X11; Linux x86_64; rv:10.0) Gecko/20100101 Firefox/10.0'
+        before = mldb.get("/v1/functions/useragent/cache").json()
+        self.assertTrue(before['enabled'])
+        self.assertEqual(before['capacity'], 10000)
+
+        first = mldb.query("select useragent({ua: '%s'}) as *" % ua)
+        second = mldb.query("select useragent({ua: '%s'}) as *" % ua)
+        self.assertEqual(first, second)
+
+        after = mldb.get("/v1/functions/useragent/cache").json()
+        self.assertEqual(after['misses'], before['misses'] + 1)
+        self.assertEqual(after['hits'], before['hits'] + 1)
+
+        mldb.put("/v1/functions/useragent_nocache", {
+            "type": "http.useragent",
+            "cacheSize": 0,
+            "params": {
+                "regexFile": "mldb/plugins/html/ext/uap-core/regexes.yaml"
+            }
+        })
+        self.assertFalse(
+            mldb.get("/v1/functions/useragent_nocache/cache").json()['enabled'])
+
 
 if __name__ == '__main__':
     mldb.run_tests()
@@ -45,4 +45,32 @@ class DatasetFunctionTest(MldbUnitTest):
         self.assertTableResultEquals(res1, expected1)
         self.assertTableResultEquals(res2, expected2)
 
+    def test_order_by_limit(self):
+        # Only the first offset + limit rows are kept while sorting; the
+        # result must be the same as sorting everything
+        ds = mldb.create_dataset({ "id": "order_by_limit", "type": "sparse.mutable" })
+        values = {}
+        for i in range(5000):
+            values["row%d" % i] = (i * 7919) % 5003
+            ds.record_row("row%d" % i, [["v", values["row%d" % i], 0],
+                                        ["k", i % 3 + 1, 0]])
+        ds.commit()
+
+        expected = sorted(values.items(), key=lambda kv: -kv[1])[5:15]
+
+        res = mldb.query("""
+            SELECT v FROM order_by_limit
+            ORDER BY v DESC LIMIT 10 OFFSET 5
+        """)
+        self.assertEqual([r[1] for r in res[1:]], [v for k, v in expected])
+        self.assertEqual([r[0] for r in res[1:]], [k for k, v in expected])
+
+        # Same through a join, which sorts in the execution pipeline
+        res = mldb.query("""
+            SELECT b.v AS v FROM order_by_limit AS b
+            JOIN dataset1 AS a ON b.k = a.x
+            ORDER BY b.v DESC LIMIT 10 OFFSET 5
+        """)
+        self.assertEqual([r[1] for r in res[1:]], [v for k, v in expected])
+
 mldb.run_tests()
@@ -80,5 +80,65 @@ class MLDB1899DuplicatedRowsInEquijoins(MldbUnitTest):  # noqa
         #mldb.log(resp)
         self.assertEqual(resp[1][1], 550, "expected 550 rows to be returned")
 
+    def test_large_equijoins(self):
+        # enough rows that the join is done in parallel partitions, with
+        # keys that are duplicated, null or only on one side
+        left = mldb.create_dataset({ "id": "large_left", "type": "sparse.mutable" })
+        right = mldb.create_dataset({ "id": "large_right", "type": "sparse.mutable" })
+        left_keys = []
+        right_keys = []
+        for index in range(20000):
+            key = None if index % 97 == 0 else index % 1000
+            left_keys.append(key)
+            if key is None:
+                left.record_row(index, [["other", index, 0]])
+            else:
+                left.record_row(index, [["k", key, 0]])
+
+            key = None if index % 89 == 0 else index % 1500
+            right_keys.append(key)
+            if key is None:
+                right.record_row(index, [["other", index, 0]])
+            else:
+                right.record_row(index, [["k", key, 0]])
+        left.commit()
+        right.commit()
+
+        left_counts = {}
+        for key in left_keys:
+            if key is not None:
+                left_counts[key] = left_counts.get(key, 0) + 1
+        right_counts = {}
+        for key in right_keys:
+            if key is not None:
+                right_counts[key] = right_counts.get(key, 0) + 1
+
+        inner = sum(count * right_counts.get(key, 0)
+                    for key, count in left_counts.items())
+        left_only = sum(1 for key in left_keys
+                        if key is None or key not in right_counts)
+        right_only = sum(1 for key in right_keys
+                         if key is None or key not in left_counts)
+
+        def count(join):
+            return mldb.query("""
+                SELECT count(*) FROM large_left %s large_right
+                                ON large_left.k = large_right.k
+            """ % join)[1][1]
+
+        self.assertEqual(count("JOIN"), inner)
+        self.assertEqual(count("LEFT JOIN"), inner + left_only)
+        self.assertEqual(count("RIGHT JOIN"), inner + right_only)
+        self.assertEqual(count("FULL OUTER JOIN"),
+                         inner + left_only + right_only)
+
+        # each matched row pairs rows with the same key
+        resp = mldb.query("""
+            SELECT count(*) FROM large_left JOIN large_right
+                            ON large_left.k = large_right.k
+            WHERE large_left.k != large_right.k
+        """)
+        self.assertEqual(resp[1][1], 0)
+
 if __name__ == '__main__':
     mldb.run_tests()
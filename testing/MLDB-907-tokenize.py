@@ -211,6 +211,47 @@ class TokenizeTest(MldbUnitTest):  # noqa
         self.find_column(result, "tokens",
                     '{"I.am.a":1,"and.this":1,"dog":1,"is.my":1,"life.":1}')
 
+    def test_byte_tokenizer_matches(self):
+        # A quote character makes tokenize() decode the text character by
+        # character, which must give the same result as splitting it
+        text = "l'été,,est là ; a,b;c  ,été,aa,bbb,été;;là"
+        for opts in ["splitChars: ',; '",
+                     "splitChars: ',', minTokenLength: 2",
+                     "splitChars: ',; ', offset: 2, limit: 4",
+                     "splitChars: ';', minTokenLength: 0, limit: 2",
+                     "splitChars: ''"]:
+            fast = mldb.query("SELECT tokenize('{}', {{{}}}) AS *"
+                              .format(text.replace("'", "''"), opts))
+            slow = mldb.query("SELECT tokenize('{}', {{{}, quoteChar: '\"'}}) AS *"
+                              .format(text.replace("'", "''"), opts))
+            self.assertEqual(dict(zip(fast[0][1:], fast[1][1:])),
+                             dict(zip(slow[0][1:], slow[1][1:])))
+
+    def test_hash_buckets(self):
+        res = mldb.query("""
+            SELECT tokenize('a b b c c c', {splitChars: ' ',
+                                            hashBuckets: 4}) AS *""")
+        self.assertLessEqual(len(res[0]) - 1, 3)
+        self.assertTrue(all(0 <= int(c) < 4 for c in res[0][1:]))
+        self.assertEqual(sum(res[1][1:]), 6)
+
+        # Ngrams are hashed as if their tokens were joined by underscores
+        res = mldb.query("""
+            SELECT tokenize('a b', {splitChars: ' ', ngramRange: [2, 2],
+                                    hashBuckets: 1000}) AS ngram,
+                   tokenize('a_b', {hashBuckets: 1000}) AS token,
+                   tokenize('a b', {splitChars: ' ', ngramRange: [2, 2],
+                                    hashBuckets: 1000,
+                                    quoteChar: '"'}) AS quoted""")
+        self.assertEqual(len(res[0]), 4)
+        self.assertEqual(res[0][1].split('.')[1], res[0][2].split('.')[1])
+        self.assertEqual(res[0][1].split('.')[1], res[0][3].split('.')[1])
+
+        res = mldb.query("""
+            SELECT tokenize('a b b', {splitChars: ' ', hashBuckets: 1,
+                                      value: 'x'}) AS *""")
+        self.assertEqual(res, [['_rowName', '0'], ['result', 'x']])
+
     def test_tokenize_null(self):
         """
         MLDB-1726
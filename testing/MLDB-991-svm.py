@@ -93,6 +93,30 @@ class SvmTest(unittest.TestCase):
         mldb.log(result)
         self.assertEqual(result.json()['output']['output'], 72)
 
+    def test_linear_kernel(self):
+        # the linear kernel uses its own solver unless fastLinear is off
+        for name, fast in [('fast', True), ('smo', False)]:
+            mldb.put("/v1/procedures/svm_linear_" + name, {
+                "type": "svm.train",
+                "params": {
+                    "trainingData": {"from" : {"id": "dataset1"}},
+                    "configuration": {"kernel": "linear",
+                                      "fastLinear": fast,
+                                      "cacheSize": 10},
+                    "modelFileUrl": "file://tmp/MLDB-991-linear-{}.svm"
+                                    .format(name),
+                    "functionName": "svm_linear_function_" + name,
+                    "runOnCreation": True
+                }
+            })
+
+            for x, y, label in [(1, -1, 39), (-1, 1, 72), (0.5, -0.5, 39)]:
+                result = mldb.get(
+                    '/v1/functions/svm_linear_function_{}/application'
+                    .format(name),
+                    input={'embedding' : {'x': x, 'y': y}})
+                self.assertEqual(result.json()['output']['output'], label)
+
     def test_iris_dataset_classicfication(self):
         # Iris dataset classification test
 
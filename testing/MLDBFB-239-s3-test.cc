@@ -192,6 +192,18 @@ BOOST_AUTO_TEST_CASE( test_s3_large_files )
         }
         stream.close();
     }
+
+    /* download with filter_istream, with the part size and number of
+       requests in flight set by the options */
+    {
+        filter_istream stream(fileUrl, { { "part-size", "1000000" },
+                                         { "num-requests", "7" } });
+        string downloaded((std::istreambuf_iterator<char>(stream)),
+                          std::istreambuf_iterator<char>());
+        stream.close();
+        BOOST_CHECK_EQUAL(downloaded.size(), contents.size());
+        BOOST_CHECK(downloaded == contents);
+    }
 }
 #endif
 
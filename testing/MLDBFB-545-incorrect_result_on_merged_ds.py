@@ -94,5 +94,54 @@ class Mldbfb545MergeDsWhereQueryTest(MldbUnitTest):  # noqa
         mldb.log(res)
         self.assertEqual(len(res), 1)
 
+    def test_where_on_disjoint_and_overlapping_rows(self):
+        ds = mldb.create_dataset({'id' : 'part1', 'type': 'sparse.mutable'})
+        ds.record_row('user1', [['a', 1, 0]])
+        ds.record_row('user2', [['a', 2, 0]])
+        ds.commit()
+
+        ds = mldb.create_dataset({'id' : 'part2', 'type': 'sparse.mutable'})
+        ds.record_row('user3', [['a', 1, 0], ['b', 1, 0]])
+        ds.commit()
+
+        ds = mldb.create_dataset({'id' : 'part3', 'type': 'sparse.mutable'})
+        ds.record_row('user1', [['b', 2, 0]])
+        ds.commit()
+
+        # No row is in both datasets, so each one finds its own rows
+        mldb.put("/v1/datasets/disjoint_parts", {
+            "type": "merged",
+            "params": {
+                "datasets": [{"id": 'part1'}, {"id": 'part2'}]
+            }
+        })
+        res = mldb.query("SELECT a FROM disjoint_parts WHERE a = 1 "
+                         "ORDER BY rowName()")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'a'],
+            ['user1', 1],
+            ['user3', 1]
+        ])
+        res = mldb.query("SELECT a FROM disjoint_parts "
+                         "WHERE rowName() = 'user3' AND a = 1")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'a'],
+            ['user3', 1]
+        ])
+
+        # user1 takes a from one dataset and b from the other
+        mldb.put("/v1/datasets/overlapping_parts", {
+            "type": "merged",
+            "params": {
+                "datasets": [{"id": 'part1'}, {"id": 'part3'}]
+            }
+        })
+        res = mldb.query("SELECT a, b FROM overlapping_parts "
+                         "WHERE a = 1 AND b = 2")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'a', 'b'],
+            ['user1', 1, 2]
+        ])
+
 if __name__ == '__main__':
     mldb.run_tests()
@@ -27,6 +27,21 @@ class MldbFb573(MldbUnitTest):
         })
         
         
+    def test_extract_column(self):
+        # Reading one field only builds that field; it must give the same
+        # result as reading it from the whole parsed document
+        for field in ['title', 'similars', 'missing', 'title.x']:
+            self.assertTableResultEquals(
+                mldb.query("select parse_json(x)[%s] as v from sample" % field),
+                mldb.query("select v[%s] as v from (select parse_json(x) as v from sample)" % field))
+
+        # A malformed document is still an error, even after the field
+        ds = mldb.create_dataset({ "id": "bad_json", "type": "sparse.mutable" })
+        ds.record_row("a",[["x", '{"title": "ok", "y": [1,]}', 0]])
+        ds.commit()
+        with self.assertRaises(ResponseException):
+            mldb.query("select parse_json(x)[title] from bad_json")
+
     def test_ignore_errors(self):
         for arrays in ["parse", "encode"]:
             self.assertTableResultEquals(
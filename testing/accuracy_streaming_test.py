@@ -0,0 +1,81 @@
+#
+# accuracy_streaming_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that the streaming mode of classifier.test gives the same results as
+# the default one, exactly when there are few distinct scores and closely
+# when the scores need to be rounded.
+#
+import datetime
+import math
+import random
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class AccuracyStreamingTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        ds = mldb.create_dataset({'id' : 'scores', 'type' : 'tabular'})
+        now = datetime.datetime.now()
+        for i in range(5000):
+            label = random.random() < 0.3
+            score = 1.0 / (1.0 + math.exp(-random.gauss(label, 1)))
+            ds.record_row('row%d' % i, [
+                ['score', score, now],
+                ['coarse', round(score, 2), now],
+                ['label', label, now],
+                ['weight', random.random() + 0.5, now]])
+        ds.commit()
+
+    def run_test(self, score, **kwargs):
+        params = {
+            'testingData' : 'SELECT %s AS score, label, weight FROM scores'
+                            % score,
+            'mode' : 'boolean',
+            'outputDataset' : {'id' : 'accuracy_streaming_output',
+                               'type' : 'tabular'},
+            'runOnCreation' : True
+        }
+        params.update(kwargs)
+        res = mldb.put('/v1/procedures/accuracy_streaming', {
+            'type' : 'classifier.test',
+            'params' : params
+        })
+        return res.json()['status']['firstRun']['status']
+
+    def test_exact(self):
+        expected = self.run_test('coarse', uniqueScoresOnly=True)
+        streaming = self.run_test('coarse', streaming=True)
+
+        self.assertTrue(streaming.pop('exact'))
+        self.assertAlmostEqual(streaming['auc'], expected['auc'], places=6)
+        for best in ['bestF1Score', 'bestMcc']:
+            self.assertEqual(streaming[best]['threshold'],
+                             expected[best]['threshold'])
+            self.assertAlmostEqual(streaming[best]['pr']['f1Score'],
+                                   expected[best]['pr']['f1Score'], places=6)
+
+        # One row per distinct score
+        [[_, count]] = mldb.query(
+            'SELECT count(*) FROM accuracy_streaming_output')[1:]
+        [[_, scores]] = mldb.query(
+            'SELECT count_distinct(coarse) FROM scores')[1:]
+        self.assertEqual(count, scores)
+
+    def test_rounded(self):
+        expected = self.run_test('score')
+        streaming = self.run_test('score', streaming=True, maxExactScores=100,
+                                  scorePrecisionBits=10)
+
+        self.assertFalse(streaming['exact'])
+        self.assertAlmostEqual(streaming['auc'], expected['auc'], places=3)
+
+    def test_validation(self):
+        with self.assertRaises(ResponseException):
+            self.run_test('score', streaming=True, mode='regression')
+        with self.assertRaises(ResponseException):
+            self.run_test('score', streaming=True, scorePrecisionBits=0)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,233 @@
+#
+# arrow_output_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Tests of the arrow format of /v1/query and of the export.arrow procedure.
+# The output is read by the minimal Arrow reader below, so that the test
+# doesn't need pyarrow.
+#
+import struct
+import tempfile
+import requests
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+
+class FlatTable(object):
+    """Table of a FlatBuffer, whose fields are read by number"""
+
+    def __init__(self, buf, pos):
+        self.buf = buf
+        self.pos = pos
+        self.vtable = pos - struct.unpack_from('<i', buf, pos)[0]
+        self.vtable_len = struct.unpack_from('<H', buf, self.vtable)[0]
+
+    def field(self, n):
+        if 4 + 2 * n >= self.vtable_len:
+            return None
+        offset = struct.unpack_from('<H', self.buf, self.vtable + 4 + 2 * n)[0]
+        return self.pos + offset if offset else None
+
+    def scalar(self, n, fmt, default=0):
+        pos = self.field(n)
+        return default if pos is None else \
+            struct.unpack_from(fmt, self.buf, pos)[0]
+
+    def ref(self, n):
+        pos = self.field(n)
+        return pos + struct.unpack_from('<I', self.buf, pos)[0]
+
+    def table(self, n):
+        return FlatTable(self.buf, self.ref(n))
+
+    def string(self, n):
+        pos = self.ref(n)
+        length = struct.unpack_from('<I', self.buf, pos)[0]
+        return self.buf[pos + 4:pos + 4 + length].decode('utf-8')
+
+    def vector(self, n):
+        """Return the position of the elements and their number"""
+        if self.field(n) is None:
+            return 0, 0
+        pos = self.ref(n)
+        return pos + 4, struct.unpack_from('<I', self.buf, pos)[0]
+
+    def tables(self, n):
+        pos, count = self.vector(n)
+        return [FlatTable(self.buf, pos + 4 * i
+                          + struct.unpack_from('<I', self.buf, pos + 4 * i)[0])
+                for i in range(count)]
+
+
+def flat_root(buf):
+    return FlatTable(buf, struct.unpack_from('<I', buf, 0)[0])
+
+# Values of the Type union
+INT, FLOATING_POINT, BINARY, UTF8, TIMESTAMP = 2, 3, 4, 5, 10
+
+def read_schema(schema):
+    return [(f.string(0), f.scalar(2, '<B')) for f in schema.tables(1)]
+
+def read_batch(batch, body, fields, columns):
+    nodes_pos, num_nodes = batch.vector(1)
+    buffers_pos, num_buffers = batch.vector(2)
+    buffers = [struct.unpack_from('<qq', batch.buf, buffers_pos + 16 * i)
+               for i in range(num_buffers)]
+    remaining = iter(buffers)
+    for i, (name, type_) in enumerate(fields):
+        length, null_count = struct.unpack_from('<qq', batch.buf,
+                                                nodes_pos + 16 * i)
+        offset, size = next(remaining)
+        validity = body[offset:offset + size]
+        valid = lambda r: not null_count or validity[r // 8] >> (r % 8) & 1
+        offset, size = next(remaining)
+        values = body[offset:offset + size]
+        if type_ in (UTF8, BINARY):
+            offset, size = next(remaining)
+            data = body[offset:offset + size]
+        for r in range(length):
+            if not valid(r):
+                columns[name].append(None)
+            elif type_ in (INT, TIMESTAMP):
+                columns[name].append(struct.unpack_from('<q', values, 8 * r)[0])
+            elif type_ == FLOATING_POINT:
+                columns[name].append(struct.unpack_from('<d', values, 8 * r)[0])
+            else:
+                start, end = struct.unpack_from('<ii', values, 4 * r)
+                v = data[start:end]
+                columns[name].append(v.decode('utf-8') if type_ == UTF8 else v)
+
+def read_stream(buf, pos=0):
+    """Read an Arrow IPC stream, returning (fields, columns, metadata of the
+       last batch, position of the end)"""
+    fields = None
+    columns = None
+    metadata = {}
+    while True:
+        marker, length = struct.unpack_from('<Ii', buf, pos)
+        assert marker == 0xffffffff
+        pos += 8
+        if length == 0:
+            return fields, columns, metadata, pos
+        message = flat_root(buf[pos:pos + length])
+        pos += length
+        body_length = message.scalar(3, '<q')
+        body = buf[pos:pos + body_length]
+        pos += body_length
+        header_type = message.scalar(1, '<B')
+        if header_type == 1:
+            fields = read_schema(message.table(2))
+            columns = {name: [] for name, type_ in fields}
+        else:
+            assert header_type == 3
+            read_batch(message.table(2), body, fields, columns)
+            metadata = {kv.string(0): kv.string(1) for kv in message.tables(4)}
+
+def read_file(buf):
+    assert buf[:6] == b'ARROW1' and buf[-6:] == b'ARROW1'
+    fields, columns, metadata, pos = read_stream(buf, 8)
+    footer_length = struct.unpack_from('<i', buf, len(buf) - 10)[0]
+    footer = flat_root(buf[len(buf) - 10 - footer_length:len(buf) - 10])
+    assert read_schema(footer.table(1)) == fields
+    return fields, columns, footer.vector(3)[1]
+
+
+class ArrowOutputTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(2500):
+            cols = [['x', i, 0], ['y', 'row%d' % i, 0], ['f', i / 4.0, 0]]
+            if i % 7:
+                cols.append(['opt', i, 0])
+            if i >= 2000:
+                cols.append(['z', i * 2, 0])
+            ds.record_row('r%04d' % i, cols)
+        ds.commit()
+
+    def query(self, q, **params):
+        params.update({ 'q' : q, 'format' : 'arrow' })
+        return requests.get(url + '/v1/query', params=params)
+
+    def test_query(self):
+        r = self.query('SELECT x, y, f, opt FROM ds ORDER BY x')
+        self.assertEqual(r.status_code, 200)
+        self.assertEqual(r.headers['content-type'],
+                         'application/vnd.apache.arrow.stream')
+        fields, columns, metadata, end = read_stream(r.content)
+        self.assertEqual(end, len(r.content))
+        self.assertEqual(metadata, {})
+        self.assertEqual(fields, [('_rowName', UTF8), ('x', INT),
+                                  ('y', UTF8), ('f', FLOATING_POINT),
+                                  ('opt', INT)])
+        self.assertEqual(columns['_rowName'][:2], ['r0000', 'r0001'])
+        self.assertEqual(columns['x'], list(range(2500)))
+        self.assertEqual(columns['y'][2499], 'row2499')
+        self.assertEqual(columns['f'][3], 0.75)
+        self.assertEqual(columns['opt'][:3], [None, 1, 2])
+
+    def test_timestamps(self):
+        r = self.query("SELECT TIMESTAMP '2016-01-02T03:04:05.5Z' AS ts",
+                       rowNames=False)
+        fields, columns, metadata, end = read_stream(r.content)
+        self.assertEqual(fields, [('ts', TIMESTAMP)])
+        self.assertEqual(columns['ts'], [1451703845500000])
+
+    def test_late_column(self):
+        # z first appears after the rows that the schema is taken from;
+        # since output has already been sent, the error ends the stream
+        r = self.query('SELECT x, z FROM ds ORDER BY x')
+        self.assertEqual(r.status_code, 200)
+        fields, columns, metadata, end = read_stream(r.content)
+        self.assertEqual(int(metadata['httpCode']), 400)
+        self.assertIn("Column 'z'", metadata['error'])
+
+    def test_type_change(self):
+        # x is an integer in the rows that the schema is taken from
+        r = self.query("SELECT CASE WHEN x < 2000 THEN x ELSE 'big' END AS x "
+                       "FROM ds ORDER BY rowName()")
+        fields, columns, metadata, end = read_stream(r.content)
+        self.assertEqual(fields[1], ('x', INT))
+        self.assertIn("of type int64", metadata['error'])
+
+    def test_export(self):
+        f = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp',
+                                        suffix='.arrow')
+        res = mldb.post('/v1/procedures', {
+            'type' : 'export.arrow',
+            'params' : {
+                'exportData' : 'SELECT rowName() AS name, x, y, f, opt '
+                               'FROM ds ORDER BY x',
+                'dataFileUrl' : 'file://' + f.name,
+                'rowsPerBatch' : 1000,
+                'runOnCreation' : True
+            }
+        }).json()
+        self.assertEqual(res['status']['firstRun']['status']['rowCount'],
+                         2500)
+
+        with open(f.name, 'rb') as stream:
+            fields, columns, num_batches = read_file(stream.read())
+        self.assertEqual(num_batches, 3)
+        self.assertEqual(fields, [('name', UTF8), ('x', INT), ('y', UTF8),
+                                  ('f', FLOATING_POINT), ('opt', INT)])
+        self.assertEqual(columns['x'], list(range(2500)))
+        self.assertEqual(columns['name'][10], 'r0010')
+        self.assertEqual(columns['opt'][7:9], [None, 8])
+
+    def test_export_bad_query(self):
+        with self.assertRaises(ResponseException):
+            mldb.post('/v1/procedures', {
+                'type' : 'export.arrow',
+                'params' : {
+                    'exportData' : 'SELECT x',
+                    'dataFileUrl' : 'file://build/x86_64/tmp/bad.arrow',
+                    'runOnCreation' : True
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,104 @@
+/** bucket_test.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Tests for the bucketization of column values.
+*/
+
+#include "mldb/engine/bucket.h"
+#include "mldb/sql/cell_value.h"
+#include "mldb/types/string.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <random>
+
+
+using namespace std;
+
+using namespace MLDB;
+
+BOOST_AUTO_TEST_CASE( test_batch_buckets_match_single )
+{
+    std::mt19937 rng(1);
+
+    std::vector<CellValue> values;
+    for (unsigned i = 0;  i < 10000;  ++i) {
+        switch (rng() % 4) {
+        case 0: values.emplace_back((int)(rng() % 1000));  break;
+        case 1: values.emplace_back((rng() % 10000) / 7.0);  break;
+        case 2: values.emplace_back("s" + to_string(rng() % 20));  break;
+        case 3: values.emplace_back();  break;
+        }
+    }
+
+    for (int numBuckets: { -1, 1, 7, 255 }) {
+        BucketDescriptions desc;
+        desc.initialize(values, numBuckets);
+
+        std::vector<uint32_t> buckets(values.size());
+        desc.getBuckets(values.data(), values.size(), buckets.data());
+
+        for (size_t i = 0;  i < values.size();  ++i)
+            BOOST_REQUIRE_EQUAL(buckets[i], desc.getBucket(values[i]));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_write_parallel )
+{
+    std::mt19937 rng(2);
+
+    for (uint32_t numBuckets: { 2, 3, 200, 70000 }) {
+        std::vector<uint32_t> values(300000);
+        for (auto & v: values)
+            v = rng() % numBuckets;
+
+        WritableBucketList parallel(values.size(), numBuckets);
+        parallel.writeParallel(values.data(), values.size());
+
+        WritableBucketList serial(values.size(), numBuckets);
+        for (auto & v: values)
+            serial.write(v);
+
+        for (size_t i = 0;  i < values.size();  ++i) {
+            BOOST_REQUIRE_EQUAL(parallel[i], values[i]);
+            BOOST_REQUIRE_EQUAL(serial[i], values[i]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_sketched_splits )
+{
+    // Enough values for the splits to come from a quantile sketch
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> dist(0, 1000);
+    std::vector<double> values(2000000);
+    for (auto & v: values)
+        v = dist(rng);
+
+    auto splits = NumericValues::calcSplits(values, 100);
+    BOOST_CHECK_GE(splits.size(), 10);
+    BOOST_CHECK_LE(splits.size(), 100);
+    BOOST_CHECK(std::is_sorted(splits.begin(), splits.end()));
+
+    // The buckets are about the same size
+    NumericValues numeric;
+    numeric.active = true;
+    numeric.splits = splits;
+    std::vector<uint32_t> buckets(values.size());
+    numeric.getBuckets(values.data(), values.size(), buckets.data());
+
+    std::vector<size_t> counts(splits.size() + 1);
+    for (size_t i = 0;  i < values.size();  ++i) {
+        BOOST_REQUIRE_EQUAL(buckets[i], numeric.getBucket(values[i]));
+        counts[buckets[i]] += 1;
+    }
+
+    size_t expected = values.size() / counts.size();
+    for (size_t i = 1;  i + 1 < counts.size();  ++i) {
+        BOOST_CHECK_GE(counts[i], expected / 3);
+        BOOST_CHECK_LE(counts[i], expected * 3);
+    }
+}
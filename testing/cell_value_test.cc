@@ -17,6 +17,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include <climits>
+#include <thread>
 
 
 using namespace std;
@@ -521,3 +522,51 @@ BOOST_AUTO_TEST_CASE (test_sorting_absolute_order)
         }
     }
 }
+
+BOOST_AUTO_TEST_CASE (test_long_payload_shared_on_copy)
+{
+    std::string str(100, 'x');
+    vector<CellValue> vals = {
+        CellValue(str),
+        CellValue(Utf8String("\xc3\xa9" + str)),
+        CellValue::blob(str),
+        CellValue(Path({ PathElement(str), PathElement("y") }))
+    };
+
+    for (auto & val: vals) {
+        CellValue copy(val);
+        BOOST_CHECK_EQUAL(copy, val);
+        if (val.isString() || val.cellType() == CellValue::PATH)
+            BOOST_CHECK_EQUAL((const void *)copy.stringChars(),
+                              (const void *)val.stringChars());
+        else BOOST_CHECK_EQUAL((const void *)copy.blobData(),
+                               (const void *)val.blobData());
+
+        // The copy outlives the original
+        CellValue assigned;
+        {
+            CellValue tmp(copy);
+            assigned = tmp;
+        }
+        BOOST_CHECK_EQUAL(assigned, val);
+        BOOST_CHECK_EQUAL(assigned.hash(), val.hash());
+    }
+
+    // Copies and destructions from many threads at once
+    CellValue shared(str);
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0;  t < 8;  ++t) {
+        threads.emplace_back([&] ()
+            {
+                for (unsigned i = 0;  i < 100000;  ++i) {
+                    CellValue copy(shared);
+                    errors += copy.toStringLength() != 100;
+                }
+            });
+    }
+    for (auto & t: threads)
+        t.join();
+    BOOST_CHECK_EQUAL(errors, 0);
+    BOOST_CHECK_EQUAL(shared.toString(), str);
+}
@@ -0,0 +1,99 @@
+#
+# classifier_batch_apply_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that applying classifier functions to a batch of inputs through
+# the /batch route gives the same results as applying them one at a time.
+#
+from mldb import mldb, MldbUnitTest
+
+class ClassifierBatchApplyTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.post('/v1/procedures', {
+            'type' : 'import.text',
+            'params' : {
+                'dataFileUrl' : 'file://mldb/testing/dataset/iris.data',
+                'outputDataset' : 'iris',
+                'headers' : ['a', 'b', 'c', 'd', 'class'],
+                'runOnCreation' : True
+            }
+        })
+
+        for mode, label in [('boolean', "class = 'Iris-setosa'"),
+                            ('categorical', 'class'),
+                            ('regression', 'd')]:
+            features = '{a, b, c}' if mode == 'regression' else '{a, b, c, d}'
+            mldb.post('/v1/procedures', {
+                'type' : 'classifier.train',
+                'params' : {
+                    'trainingData' : 'SELECT %s AS features, %s AS label '
+                                     'FROM iris' % (features, label),
+                    'modelFileUrl' : 'file://tmp/classifier_batch_%s.cls'
+                                     % mode,
+                    'algorithm' : 'dt',
+                    'configurationFile' :
+                        './mldb/container_files/classifiers.json',
+                    'mode' : mode,
+                    'functionName' : 'cls_' + mode,
+                    'runOnCreation' : True
+                }
+            })
+
+        cls.rows = mldb.query('SELECT a, b, c, d FROM iris '
+                              'ORDER BY rowName() LIMIT 40')[1:]
+
+    def inputs(self):
+        inputs = [{'features' : {'a' : r[1], 'b' : r[2], 'c' : r[3],
+                                 'd' : r[4]}}
+                  for r in self.rows]
+        # Missing and unknown features
+        inputs.append({'features' : {'a' : 5.0, 'e' : 1}})
+        return inputs
+
+    def check_mode(self, mode):
+        inputs = self.inputs()
+        batch = mldb.get('/v1/functions/cls_%s/batch' % mode,
+                         input=inputs).json()
+        self.assertEqual(len(batch), len(inputs))
+        for input, output in zip(inputs, batch):
+            one = mldb.get('/v1/functions/cls_%s/application' % mode,
+                           input=input, outputFormat='json').json()
+            self.assertEqual(output, one)
+
+    def test_boolean(self):
+        self.check_mode('boolean')
+
+    def test_categorical(self):
+        self.check_mode('categorical')
+
+    def test_regression(self):
+        self.check_mode('regression')
+
+    def test_object_input(self):
+        inputs = self.inputs()
+        batch = mldb.get('/v1/functions/cls_categorical/batch',
+                         input={'x' : inputs[0], 'y' : inputs[1]}).json()
+        self.assertEqual(sorted(batch.keys()), ['x', 'y'])
+        self.assertEqual(
+            batch['y'],
+            mldb.get('/v1/functions/cls_categorical/application',
+                     input=inputs[1], outputFormat='json').json())
+
+    def test_explain(self):
+        mldb.put('/v1/functions/explain', {
+            'type' : 'classifier.explain',
+            'params' : {
+                'modelFileUrl' : 'file://tmp/classifier_batch_boolean.cls'
+            }
+        })
+        inputs = [dict(i, label=1) for i in self.inputs()[:5]]
+        batch = mldb.get('/v1/functions/explain/batch', input=inputs).json()
+        for input, output in zip(inputs, batch):
+            one = mldb.get('/v1/functions/explain/application',
+                           input=input, outputFormat='json').json()
+            self.assertEqual(output, one)
+
+if __name__ == '__main__':
+    mldb.run_tests()
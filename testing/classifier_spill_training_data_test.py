@@ -0,0 +1,58 @@
+#
+# classifier_spill_training_data_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that training a classifier with its training data spilled to a
+# memory mapped file gives the same model as keeping it in memory.
+#
+import filecmp
+from mldb import mldb, MldbUnitTest
+
+class ClassifierSpillTrainingDataTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.post('/v1/procedures', {
+            'type' : 'import.text',
+            'params' : {
+                'dataFileUrl' : 'file://mldb/testing/dataset/iris.data',
+                'outputDataset' : 'iris',
+                'headers' : ['a', 'b', 'c', 'd', 'class'],
+                'runOnCreation' : True
+            }
+        })
+
+    def train(self, mode, label, spill):
+        url = 'file://tmp/classifier_spill_%s_%d.cls' % (mode, spill)
+        mldb.post('/v1/procedures', {
+            'type' : 'classifier.train',
+            'params' : {
+                'trainingData' : 'SELECT {a, b, c} AS features, %s AS label '
+                                 'FROM iris' % label,
+                'modelFileUrl' : url,
+                'algorithm' : 'bbdt',
+                'configurationFile' :
+                    './mldb/container_files/classifiers.json',
+                'mode' : mode,
+                'spillTrainingData' : spill,
+                'runOnCreation' : True
+            }
+        })
+        return url[len('file://'):]
+
+    def check_mode(self, mode, label):
+        inMemory = self.train(mode, label, False)
+        spilled = self.train(mode, label, True)
+        self.assertTrue(filecmp.cmp(inMemory, spilled, shallow=False))
+
+    def test_boolean(self):
+        self.check_mode('boolean', "class = 'Iris-setosa'")
+
+    def test_categorical(self):
+        self.check_mode('categorical', 'class')
+
+    def test_regression(self):
+        self.check_mode('regression', 'd')
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+#
+# compare_benchmarks.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Compare two sets of results written by macro_benchmark.py:
+#
+#   compare_benchmarks.py baseline.json candidate.json [--threshold 0.1]
+#
+# Prints the change in time of each benchmark, and exits with status 1 if
+# any is slower than the baseline by more than the threshold (a fraction).
+#
+import argparse
+import json
+import sys
+
+
+def load(filename):
+    with open(filename) as f:
+        return json.load(f)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Compare two sets of macro benchmark results')
+    parser.add_argument('baseline')
+    parser.add_argument('candidate')
+    parser.add_argument('--threshold', type=float, default=0.1,
+                        help='Slowdown (as a fraction) that is a regression')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    candidate = load(args.candidate)
+
+    if baseline.get('rows') != candidate.get('rows') \
+       or baseline.get('seed') != candidate.get('seed'):
+        print('warning: the results are over different data (rows %s vs %s)'
+              % (baseline.get('rows'), candidate.get('rows')))
+
+    regressions = []
+    names = sorted(set(baseline['results']) | set(candidate['results']))
+    print('%-24s %12s %12s %9s' % ('benchmark', 'baseline', 'candidate',
+                                   'change'))
+    for name in names:
+        before = baseline['results'].get(name)
+        after = candidate['results'].get(name)
+        if before is None or after is None:
+            print('%-24s %12s %12s %9s'
+                  % (name, 'missing' if before is None else
+                     '%.3fs' % before['seconds'],
+                     'missing' if after is None else
+                     '%.3fs' % after['seconds'], ''))
+            continue
+
+        change = (after['seconds'] - before['seconds']) / before['seconds'] \
+            if before['seconds'] > 0 else 0.0
+        flag = ''
+        if change > args.threshold:
+            regressions.append(name)
+            flag = '  REGRESSION'
+        print('%-24s %11.3fs %11.3fs %+8.1f%%%s'
+              % (name, before['seconds'], after['seconds'], change * 100,
+                 flag))
+
+    if regressions:
+        print('%d regression(s): %s' % (len(regressions),
+                                        ', '.join(regressions)))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,176 @@
+#
+# continuous_partial_aggregates_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that GROUP BY over a continuous.window with partialAggregates gives
+# the same result as without, and reuses the groups of each dataset.
+#
+from dateutil.tz import tzlocal
+import datetime
+import os
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class ContinuousPartialAggregatesTest(MldbUnitTest):  # noqa
+
+    filename = 'tmp/continuous_partial_aggregates_metadata.sqlite'
+
+    @classmethod
+    def setUpClass(cls):
+        create_storage_js = """
+        var config = { type: "beh.binary.mutable" };
+        var dataset = mldb.createDataset(config);
+        var output = { config: dataset.config() };
+        output;
+        """
+
+        save_storage_js = """
+        var uri = "file://tmp/continuous_partial_aggregates-"
+            + new Date().toISOString() + ".beh";
+        var addr = "/v1/datasets/" + args.datasetId;
+        var res = mldb.post(addr + "/routes/saves", { dataFileUrl: uri });
+        var output = { metadata: mldb.get(addr).json.status, config: res.json};
+        output;
+        """
+
+        try:
+            os.mkdir('tmp')
+        except OSError:
+            try:
+                os.unlink(cls.filename)
+            except OSError:
+                pass
+
+        mldb.post('/v1/datasets', {
+            "id": "recorder",
+            "type": "continuous",
+            "params": {
+                "commitInterval": "0s",
+                "metadataDataset": {
+                    "type": "sqliteSparse",
+                    "id": "metadataDb",
+                    "params": {
+                        "dataFileUrl": "file://" + cls.filename
+                    }
+                },
+                "createStorageDataset": {
+                    "type": "script.run",
+                    "params": {
+                        "language": "javascript",
+                        "scriptConfig": { "source": create_storage_js }
+                    }
+                },
+                "saveStorageDataset": {
+                    "type": "script.run",
+                    "params": {
+                        "language": "javascript",
+                        "scriptConfig": { "source": save_storage_js }
+                    }
+                }
+            }
+        })
+
+        cls.num_rows = 0
+        for i in range(2):
+            cls.record_and_commit()
+
+    @classmethod
+    def record_and_commit(cls):
+        now = datetime.datetime.now(tzlocal()).isoformat()
+        for i in range(20):
+            n = cls.num_rows
+            mldb.post('/v1/datasets/recorder/rows', {
+                'rowName': 'row%d' % n,
+                'columns': [['x', n % 3, now], ['y', n, now]]
+            })
+            cls.num_rows += 1
+        mldb.post('/v1/datasets/recorder/commit')
+
+    def create_window(self, id, partial):
+        mldb.put('/v1/datasets/' + id, {
+            "type": "continuous.window",
+            "params": {
+                "metadataDataset": { "id": "metadataDb" },
+                "from": "1980-01-01T00:00:00Z",
+                "to": "2100-01-01T00:00:00Z",
+                "partialAggregates": partial
+            }
+        })
+
+    def find_group_by(self, node):
+        if node['type'] == 'GroupByQuery':
+            return node
+        for child in node.get('children', []):
+            result = self.find_group_by(child)
+            if result is not None:
+                return result
+        return None
+
+    def explain(self, query):
+        plan = mldb.get('/v1/query', q=query, explain='true').json()
+        return self.find_group_by(plan)
+
+    query = """
+        SELECT x, count(*) AS n, sum(y) AS total, min(y) AS lo,
+               max(y) AS hi, avg(y) AS mean
+        FROM {} GROUP BY x ORDER BY x
+    """
+
+    def test_same_result(self):
+        self.create_window('plain', False)
+        self.create_window('partial', True)
+
+        expected = mldb.query(self.query.format('plain'))
+        self.assertEqual(len(expected), 4)
+        self.assertTableResultEquals(
+            mldb.query(self.query.format('partial')), expected)
+
+        group = self.explain(self.query.format('partial'))
+        self.assertEqual(group['details']['partitions'], 2)
+        self.assertEqual(group['details']['partitionsReused'], 2)
+
+        # The same query over a later window only aggregates the new
+        # dataset
+        self.record_and_commit()
+        self.create_window('plain2', False)
+        self.create_window('partial2', True)
+
+        expected = mldb.query(self.query.format('plain2'))
+        self.assertEqual(sum(row[2] for row in expected[1:]), 60)
+
+        group = self.explain(self.query.format('partial2'))
+        self.assertEqual(group['details']['partitions'], 3)
+        self.assertEqual(group['details']['partitionsReused'], 2)
+
+        self.assertTableResultEquals(
+            mldb.query(self.query.format('partial2')), expected)
+
+    def test_not_kept(self):
+        self.create_window('partial3', True)
+
+        # Row aggregators can't copy their state
+        group = self.explain(
+            "SELECT x, sum({y}) AS s FROM partial3 GROUP BY x")
+        self.assertNotIn('partitions', group['details'])
+
+        # Nor are groups kept for queries with non-deterministic functions
+        group = self.explain(
+            "SELECT x, count(*) AS n FROM partial3 "
+            "WHERE now() > '1980-01-01' GROUP BY x")
+        self.assertNotIn('partitions', group['details'])
+
+    def test_save_stats(self):
+        # Saves run in the background, but commit waits for its own
+        self.record_and_commit()
+        stats = mldb.get('/v1/datasets/recorder/routes/saveStats').json()
+        self.assertEqual(stats['pendingSaves'], 0)
+        self.assertEqual(stats['maxPendingSaves'], 2)
+        self.assertEqual(stats['savesFailed'], 0)
+        self.assertGreaterEqual(stats['savesCompleted'], 3)
+        self.assertEqual(stats['rotations'], stats['savesCompleted'])
+        self.assertEqual(stats['currentSaveLagSeconds'], 0)
+        self.assertGreaterEqual(stats['maxSaveLagSeconds'],
+                                stats['lastSaveSeconds'])
+
+if __name__ == '__main__':
+    mldb.run_tests()
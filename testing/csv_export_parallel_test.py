@@ -0,0 +1,77 @@
+#
+# csv_export_parallel_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Tests of the sharded and unordered modes of the export.csv procedure.
+#
+import gzip
+import os
+import tempfile
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class CsvExportParallelTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(5000):
+            ds.record_row('r%04d' % i, [['x', i, 0], ['y', 'y,%d' % i, 0]])
+        ds.commit()
+        cls.dir = tempfile.mkdtemp(dir='build/x86_64/tmp')
+
+    def export(self, name, **params):
+        params.update({
+            'exportData' : 'SELECT x, y FROM ds ORDER BY x',
+            'dataFileUrl' : 'file://' + os.path.join(self.dir, name),
+            'runOnCreation' : True
+        })
+        mldb.post('/v1/procedures', {
+            'type' : 'export.csv',
+            'params' : params
+        })
+
+    def read(self, name):
+        path = os.path.join(self.dir, name)
+        opener = gzip.open if name.endswith('.gz') else open
+        with opener(path, 'rt') as f:
+            return f.read().splitlines()
+
+    def expected(self):
+        return ['%d,"y,%d"' % (i, i) for i in range(5000)]
+
+    def test_ordered(self):
+        self.export('ordered.csv')
+        lines = self.read('ordered.csv')
+        self.assertEqual(lines[0], 'x,y')
+        self.assertEqual(lines[1:], self.expected())
+
+    def test_shards(self):
+        self.export('part.csv.gz', numShards=3)
+        self.assertFalse(os.path.exists(os.path.join(self.dir, 'part.csv.gz')))
+        lines = []
+        for shard in range(3):
+            shard_lines = self.read('part-%05d.csv.gz' % shard)
+            self.assertEqual(shard_lines[0], 'x,y')
+            lines += shard_lines[1:]
+            # Each shard is in the order of the query
+            xs = [int(l.split(',')[0]) for l in shard_lines[1:]]
+            self.assertEqual(xs, sorted(xs))
+        self.assertEqual(sorted(lines), sorted(self.expected()))
+
+    def test_unordered(self):
+        self.export('unordered.csv', ordered=False, headers=False)
+        lines = self.read('unordered.csv')
+        self.assertEqual(sorted(lines), sorted(self.expected()))
+
+        self.export('unordered.csv', ordered=False, numShards=2)
+        lines = self.read('unordered-00000.csv')[1:] \
+            + self.read('unordered-00001.csv')[1:]
+        self.assertEqual(sorted(lines), sorted(self.expected()))
+
+    def test_bad_num_shards(self):
+        with self.assertRaises(ResponseException):
+            self.export('bad.csv', numShards=0)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,153 @@
+#
+# dataset_row_stream_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Rows streamed into a dataset through /rowstream are recorded in batches,
+# once a batch is full, once its rows have waited long enough or when the
+# dataset is committed.
+#
+import json
+import struct
+import time
+import requests
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+
+def msgpack(val):
+    """Minimal MessagePack encoder for the values used below"""
+    if isinstance(val, list):
+        return struct.pack('>BH', 0xdc, len(val)) \
+            + b''.join(msgpack(v) for v in val)
+    if isinstance(val, str):
+        data = val.encode('utf-8')
+        return struct.pack('>BB', 0xd9, len(data)) + data
+    if isinstance(val, int):
+        return struct.pack('>Bq', 0xd3, val)
+    if isinstance(val, float):
+        return struct.pack('>Bd', 0xcb, val)
+    raise Exception('unsupported')
+
+
+class DatasetRowStreamTest(MldbUnitTest):  # noqa
+
+    def create(self, name, config=None):
+        mldb.put('/v1/datasets/' + name, {'type' : 'tabular'})
+        if config is not None:
+            mldb.put('/v1/datasets/{}/rowstream'.format(name), config)
+
+    def stream(self, name, rows, **params):
+        body = ''.join(json.dumps(r) + '\n' for r in rows)
+        return requests.post(url + '/v1/datasets/{}/rowstream'.format(name),
+                             params=params, data=body,
+                             headers={'content-type' : 'application/x-ndjson'})
+
+    def status(self, name):
+        return mldb.get('/v1/datasets/{}/rowstream'.format(name)).json()
+
+    def test_commit_records_buffered_rows(self):
+        self.create('ds_commit', {'maxBatchRows' : 1000,
+                                  'maxBatchLatencySeconds' : 1000})
+        for i in range(10):
+            res = self.stream('ds_commit',
+                              [['r{}_{}'.format(i, j),
+                                [['x', j, '2016-01-01T00:00:00Z']]]
+                               for j in range(100)])
+            self.assertEqual(res.status_code, 200)
+            self.assertEqual(res.json(), {'rows' : 100})
+
+        # The last request filled the batch, which was recorded in one go
+        status = self.status('ds_commit')
+        self.assertEqual(status['rowsReceived'], 1000)
+        self.assertEqual(status['rowsRecorded'], 1000)
+        self.assertEqual(status['batchesRecorded'], 1)
+
+        self.stream('ds_commit', [['last', [['x', 1, 0]]]])
+        self.assertEqual(self.status('ds_commit')['rowsBuffered'], 1)
+
+        mldb.post('/v1/datasets/ds_commit/commit')
+        self.assertEqual(self.status('ds_commit')['rowsBuffered'], 0)
+        res = mldb.query('SELECT count(*), sum(x) FROM ds_commit')
+        self.assertEqual(res[1][1:], [1001, 10 * 4950 + 1])
+
+    def test_latency_flush(self):
+        self.create('ds_latency', {'maxBatchRows' : 1000000,
+                                   'maxBatchLatencySeconds' : 0.05,
+                                   'commitBatches' : True})
+        self.stream('ds_latency', [['a', [['x', 1, 0]]], ['b', [['x', 2, 0]]]])
+
+        for i in range(100):
+            if self.status('ds_latency')['batchesRecorded'] > 0:
+                break
+            time.sleep(0.05)
+
+        status = self.status('ds_latency')
+        self.assertEqual(status['batchesRecorded'], 1)
+        self.assertEqual(status['rowsRecorded'], 2)
+        res = mldb.query('SELECT sum(x) FROM ds_latency')
+        self.assertEqual(res[1][1], 3)
+
+    def test_backpressure(self):
+        self.create('ds_full', {'maxBatchRows' : 10,
+                                'maxPendingRows' : 10,
+                                'maxBatchLatencySeconds' : 1000,
+                                'maxWaitSeconds' : 0})
+        rows = [['r{}'.format(i), [['x', i, 0]]] for i in range(15)]
+
+        res = self.stream('ds_full', rows[:5])
+        self.assertEqual(res.status_code, 200)
+
+        # No room for 10 more while 5 are pending
+        res = self.stream('ds_full', rows[5:])
+        self.assertEqual(res.status_code, 503)
+        self.assertEqual(self.status('ds_full')['numRejected'], 1)
+
+        # Once the buffer is flushed they go through
+        self.stream('ds_full', [], flush='true')
+        res = self.stream('ds_full', rows[5:])
+        self.assertEqual(res.status_code, 200)
+        mldb.post('/v1/datasets/ds_full/commit')
+        res = mldb.query('SELECT count(*) FROM ds_full')
+        self.assertEqual(res[1][1], 15)
+
+    def test_flush_param(self):
+        self.create('ds_flush')
+        res = self.stream('ds_flush', [['a', [['x', 1, 0]]]], flush='true')
+        self.assertEqual(res.status_code, 200)
+        status = self.status('ds_flush')
+        self.assertEqual(status['rowsBuffered'], 0)
+        self.assertEqual(status['rowsRecorded'], 1)
+
+    def test_msgpack(self):
+        self.create('ds_msgpack')
+        body = msgpack(['a', [['x', 1, 0], ['y', 'hello', 0]]]) \
+            + msgpack(['b', [['x', 2.5, '2016-01-01T00:00:00Z']]])
+        res = requests.post(url + '/v1/datasets/ds_msgpack/rowstream',
+                            data=body,
+                            headers={'content-type' : 'application/msgpack'})
+        self.assertEqual(res.status_code, 200)
+        self.assertEqual(res.json(), {'rows' : 2})
+        mldb.post('/v1/datasets/ds_msgpack/commit')
+        res = mldb.query('SELECT x, y FROM ds_msgpack ORDER BY rowName()')
+        self.assertEqual(res[1:], [['a', 1, 'hello'], ['b', 2.5, None]])
+
+    def test_bad_row(self):
+        self.create('ds_bad')
+        res = requests.post(url + '/v1/datasets/ds_bad/rowstream',
+                            data='["a", [["x", 1, 0]]]\n\n{"not": "a row"}\n')
+        self.assertEqual(res.status_code, 400)
+        self.assertEqual(res.json()['details']['lineNumber'], 3)
+        self.assertEqual(self.status('ds_bad')['config']['maxBatchRows'],
+                         10000)
+
+    def test_bad_config(self):
+        self.create('ds_bad_config')
+        with self.assertRaises(ResponseException) as exc:
+            mldb.put('/v1/datasets/ds_bad_config/rowstream',
+                     {'maxBatchRows' : 100, 'maxPendingRows' : 10})
+        self.assertEqual(exc.exception.response.status_code, 400)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,57 @@
+#
+# decode_jpeg_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Decoding JPEG images into embeddings of pixels, alone or in batches.
+#
+from mldb import mldb, MldbUnitTest, ResponseException
+
+IMAGE = "fetcher('file://mldb/testing/logo-new.jpg')[content]"
+
+
+class DecodeJpegTest(MldbUnitTest):  # noqa
+
+    def value(self, expr):
+        return mldb.query('SELECT ' + expr + ' AS v')[1][1:]
+
+    def test_full_size(self):
+        self.assertEqual(self.value('shape(decode_jpeg({}))'.format(IMAGE)),
+                         [30, 150, 3])
+
+    def test_resized(self):
+        self.assertEqual(
+            self.value('shape(decode_jpeg({}, 50, 10, 1))'.format(IMAGE)),
+            [10, 50, 1])
+
+        # Every value is a byte
+        res = self.value('decode_jpeg({}, 8, 4)'.format(IMAGE))
+        self.assertEqual(len(res), 4 * 8 * 3)
+        for v in res:
+            self.assertTrue(0 <= v <= 255)
+
+    def test_batch(self):
+        self.assertEqual(self.value(
+            'shape(decode_jpeg([{0}, {0}, {0}], 20, 10))'.format(IMAGE)),
+            [3, 10, 20, 3])
+
+        # Same pixels as decoding each one
+        self.assertEqual(self.value(
+            'decode_jpeg([{0}, {0}], 20, 10)'
+            ' = [decode_jpeg({0}, 20, 10), decode_jpeg({0}, 20, 10)]'
+            .format(IMAGE)), [1])
+
+    def test_errors(self):
+        with self.assertRaises(ResponseException):
+            self.value("decode_jpeg(fetcher('file://mldb/testing/testing.mk')[content])")
+        with self.assertRaises(ResponseException):
+            self.value('decode_jpeg({}, 10)'.format(IMAGE))
+        with self.assertRaises(ResponseException):
+            self.value('decode_jpeg({}, 10, 10, 4)'.format(IMAGE))
+        with self.assertRaises(ResponseException):
+            self.value('decode_jpeg([{}], 0, 0)'.format(IMAGE))
+
+    def test_null(self):
+        self.assertEqual(self.value('decode_jpeg(NULL)'), [None])
+
+if __name__ == '__main__':
+    mldb.run_tests()
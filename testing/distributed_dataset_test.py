@@ -0,0 +1,92 @@
+#
+# distributed_dataset_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that queries of a distributed dataset, which are split between its
+# partitions and merged, give the same results as over a single dataset.
+#
+from mldb import mldb, MldbUnitTest
+
+
+class DistributedDatasetTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        rows = [
+            ['r0', [['x', 1, 0], ['y', 'a', 0]]],
+            ['r1', [['x', 2, 0], ['y', 'b', 0]]],
+            ['r2', [['x', 3, 0], ['y', 'a', 0]]],
+            ['r3', [['x', 4, 0], ['y', 'b', 0], ['z', 1, 0]]],
+            ['r4', [['x', 5, 0], ['y', 'c', 0]]],
+            ['r5', [['x', 6, 0], ['y', 'a', 0], ['z', 2, 0]]],
+            ['r6', [['y', 'c', 0]]],
+        ]
+        datasets = {
+            'all' : rows,
+            'part0' : rows[0::2],
+            'part1' : rows[1::2],
+        }
+        for dataset_id, dataset_rows in datasets.items():
+            ds = mldb.create_dataset({'id' : dataset_id,
+                                      'type' : 'sparse.mutable'})
+            for name, values in dataset_rows:
+                ds.record_row(name, values)
+            ds.commit()
+
+        mldb.put('/v1/datasets/dist', {
+            'type' : 'distributed',
+            'params' : {
+                'partitions' : [{'dataset' : 'part0'},
+                                {'dataset' : 'part1'}]
+            }
+        })
+
+    def check(self, query):
+        expected = mldb.query(query.format(ds='all'))
+        self.assertTableResultEquals(mldb.query(query.format(ds='dist')),
+                                     expected, query)
+
+    def test_rows(self):
+        for query in [
+                'SELECT * FROM {ds} ORDER BY rowName()',
+                'SELECT x, z FROM {ds} WHERE y = \'a\' ORDER BY rowName()',
+                'SELECT x * 2 AS x2 FROM {ds} ORDER BY x DESC LIMIT 3',
+                'SELECT * FROM {ds} ORDER BY x LIMIT 2 OFFSET 3',
+                'SELECT x NAMED y + \'_\' + rowName() FROM {ds} '
+                'ORDER BY rowName()',
+                'SELECT t.x FROM {ds} AS t WHERE t.x > 2 ORDER BY t.x']:
+            self.check(query)
+
+    def test_aggregates(self):
+        for query in [
+                'SELECT count(*) AS n FROM {ds}',
+                'SELECT count(x) AS n, sum(x) AS s, avg(x) AS a, '
+                'min(x) AS lo, max(x) AS hi FROM {ds}',
+                'SELECT count(*) AS n FROM {ds} WHERE x > 100',
+                'SELECT y, count(*) AS n, sum(x) + 1 AS s FROM {ds} '
+                'GROUP BY y ORDER BY y',
+                'SELECT y, avg(x) AS a FROM {ds} GROUP BY y '
+                'HAVING count(*) > 1 ORDER BY sum(x) DESC',
+                'SELECT approx_count_distinct(y) AS n FROM {ds}',
+                'SELECT count(*) AS n FROM {ds} GROUP BY z IS NULL '
+                'ORDER BY rowName()']:
+            self.check(query)
+
+    def test_unsplittable_aggregate(self):
+        self.check('SELECT y, count_distinct(x) AS n FROM {ds} GROUP BY y '
+                   'ORDER BY y')
+
+    def test_other_reads(self):
+        self.check('SELECT t.* FROM transpose({ds}) AS t '
+                   'ORDER BY rowName()')
+
+    def test_missing_partition(self):
+        with self.assertRaises(Exception):
+            mldb.put('/v1/datasets/no_partitions', {
+                'type' : 'distributed',
+                'params' : { 'partitions' : [] }
+            })
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
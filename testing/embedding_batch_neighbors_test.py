@@ -0,0 +1,110 @@
+#
+# embedding_batch_neighbors_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that answering a batch of queries at once with the queries input of
+# embedding.neighbors gives the same results as one query at a time.
+#
+import random
+from mldb import mldb, MldbUnitTest, ResponseException
+
+NUM_DIMS = 20
+NUM_ROWS = 1000
+
+def random_coords():
+    return [random.gauss(0, 1) for d in range(NUM_DIMS)]
+
+class EmbeddingBatchNeighborsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        rows = [['row%d' % i,
+                 [['x.%d' % d, v, 0] for d, v in enumerate(random_coords())]]
+                for i in range(NUM_ROWS)]
+
+        for name, params in [('vptree', {}),
+                             ('cosine', {'metric' : 'cosine'}),
+                             ('hnsw', {'index' : 'hnsw'}),
+                             ('int8', {'storage' : 'int8'})]:
+            ds = mldb.create_dataset({
+                'id' : 'emb_' + name,
+                'type' : 'embedding',
+                'params' : params})
+            ds.record_rows(rows)
+            ds.commit()
+
+            mldb.put('/v1/functions/nn_' + name, {
+                'type' : 'embedding.neighbors',
+                'params' : {'dataset' : 'emb_' + name,
+                            'columnName' : 'x',
+                            'defaultNumNeighbors' : 10}})
+
+        # Enough queries for several blocks, some of which are row names
+        cls.queries = {}
+        for i in range(150):
+            cls.queries['q%d' % i] = random_coords()
+        cls.queries['r1'] = 'row1'
+        cls.queries['r2'] = 'row2'
+
+    def literal(self, query):
+        if isinstance(query, str):
+            return "'%s'" % query
+        return '[%s]' % ', '.join(repr(v) for v in query)
+
+    def single(self, name, query, extra=''):
+        res = mldb.query("SELECT nn_%s({coords: %s%s}) AS *"
+                         % (name, self.literal(query), extra))
+        return res
+
+    def batch(self, name, extra=''):
+        return mldb.get('/v1/query', q="SELECT nn_%s({queries: {%s}%s}) AS *"
+                        % (name,
+                           ', '.join('%s: %s' % (q, self.literal(v))
+                                     for q, v in self.queries.items()),
+                           extra),
+                        format='aos').json()[0]
+
+    def check_same(self, name, extra=''):
+        batch = self.batch(name, extra)
+        for q, v in self.queries.items():
+            res = self.single(name, v, extra)
+            single = dict(zip(res[0][1:], res[1][1:]))
+
+            # The neighbors are in the same order; the distances are
+            # calculated in single precision
+            neighbors = [single['neighbors.%d' % i]
+                         for i in range(len(single))
+                         if 'neighbors.%d' % i in single]
+            self.assertEqual([batch['neighbors.%s.%d' % (q, i)]
+                              for i in range(len(neighbors))], neighbors)
+            for n in neighbors:
+                self.assertAlmostEqual(batch['distances.%s.%s' % (q, n)],
+                                       single['distances.%s' % n], places=4)
+
+    def test_vptree(self):
+        self.check_same('vptree')
+
+    def test_cosine(self):
+        self.check_same('cosine')
+
+    def test_hnsw(self):
+        self.check_same('hnsw')
+
+    def test_quantized(self):
+        self.check_same('int8')
+
+    def test_max_distance(self):
+        self.check_same('vptree', ', numNeighbors: 50, maxDistance: 5')
+        batch = self.batch('vptree', ', numNeighbors: 50, maxDistance: 5')
+        self.assertTrue(all(v <= 5 for k, v in batch.items()
+                            if k.startswith('distances.')))
+
+    def test_errors(self):
+        with self.assertRaises(ResponseException):
+            mldb.query("SELECT nn_vptree({coords: 'row1', queries: {a: 'row2'}})")
+        with self.assertRaises(ResponseException):
+            mldb.query("SELECT nn_vptree({queries: {a: [1, 2]}})")
+
+if __name__ == '__main__':
+    mldb.run_tests()
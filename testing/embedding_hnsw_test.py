@@ -0,0 +1,82 @@
+#
+# embedding_hnsw_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that the hnsw index of the embedding dataset finds (nearly) the same
+# neighbors as the exact vantage point tree, including for rows recorded
+# after a first commit.
+#
+import random
+from mldb import mldb, MldbUnitTest, ResponseException
+
+NUM_DIMS = 8
+
+def random_rows(start, end):
+    return [['row%d' % i,
+             [['x%d' % d, random.gauss(0, 1), 0] for d in range(NUM_DIMS)]]
+            for i in range(start, end)]
+
+class EmbeddingHnswTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        first = random_rows(0, 1500)
+        second = random_rows(1500, 2000)
+
+        for index in ['vpTree', 'hnsw']:
+            ds = mldb.create_dataset({
+                'id' : 'emb_' + index,
+                'type' : 'embedding',
+                'params' : {'index' : index}})
+            ds.record_rows(first)
+            ds.commit()
+            ds.record_rows(second)
+            ds.commit()
+
+            mldb.put('/v1/functions/nn_' + index, {
+                'type' : 'embedding.neighbors',
+                'params' : {'dataset' : 'emb_' + index,
+                            'defaultNumNeighbors' : 10}})
+
+    def neighbors(self, index, row):
+        res = mldb.query("SELECT nn_%s({coords: '%s'})[distances] AS *"
+                         % (index, row))
+        return dict(zip(res[0][1:], res[1][1:]))
+
+    def test_row_count(self):
+        self.assertTableResultEquals(
+            mldb.query('SELECT count(*) AS cnt FROM emb_hnsw'),
+            [['_rowName', 'cnt'], ['[]', 2000]])
+
+    def test_recall(self):
+        found = 0
+        expected = 0
+        for i in range(0, 2000, 20):
+            exact = self.neighbors('vpTree', 'row%d' % i)
+            approx = self.neighbors('hnsw', 'row%d' % i)
+            self.assertEqual(len(approx), 10)
+            self.assertEqual(approx['row%d' % i], 0)
+            for row, dist in approx.items():
+                if row in exact:
+                    self.assertAlmostEqual(dist, exact[row], places=5)
+                    found += 1
+            expected += len(exact)
+        self.assertGreaterEqual(found / float(expected), 0.95)
+
+    def test_coords_and_max_distance(self):
+        res = mldb.query(
+            "SELECT nn_hnsw({coords: {%s}, numNeighbors: 100, maxDistance: 1.5})"
+            "[distances] AS * "
+            % ', '.join('x%d: 0' % d for d in range(NUM_DIMS)))
+        self.assertTrue(all(d <= 1.5 for d in res[1][1:]))
+
+    def test_bad_params(self):
+        with self.assertRaises(ResponseException):
+            mldb.create_dataset({
+                'id' : 'emb_bad',
+                'type' : 'embedding',
+                'params' : {'index' : 'hnsw', 'hnswM' : 1}})
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,103 @@
+#
+# embedding_quantization_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check the float16 and int8 storage of the embedding dataset, and nearest
+# neighbors with product quantization and re-ranking.
+#
+import random
+from mldb import mldb, MldbUnitTest, ResponseException
+
+NUM_DIMS = 16
+NUM_ROWS = 1000
+
+class EmbeddingQuantizationTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        cls.rows = [['row%d' % i,
+                     [['x%d' % d, random.gauss(0, 1), 0]
+                      for d in range(NUM_DIMS)]]
+                    for i in range(NUM_ROWS)]
+
+        configs = {
+            'float32' : {},
+            'float16' : {'storage' : 'float16'},
+            'int8' : {'storage' : 'int8'},
+            'pq' : {'pqSubspaces' : 8},
+            'int8_pq_hnsw' : {'storage' : 'int8', 'pqSubspaces' : 8,
+                              'index' : 'hnsw', 'metric' : 'cosine'},
+            'float32_cosine' : {'metric' : 'cosine'}
+        }
+
+        for name, params in configs.items():
+            ds = mldb.create_dataset({
+                'id' : 'emb_' + name,
+                'type' : 'embedding',
+                'params' : params})
+            ds.record_rows(cls.rows)
+            ds.commit()
+
+            mldb.put('/v1/functions/nn_' + name, {
+                'type' : 'embedding.neighbors',
+                'params' : {'dataset' : 'emb_' + name,
+                            'defaultNumNeighbors' : 10}})
+
+    def check_values(self, name, tolerance):
+        res = mldb.query('SELECT * FROM emb_%s WHERE rowName() = \'row7\''
+                         % name)
+        stored = dict(zip(res[0][1:], res[1][1:]))
+        for col, val, ts in self.rows[7][1]:
+            self.assertLess(abs(stored[col] - val), tolerance)
+
+    def test_values(self):
+        self.check_values('float32', 1e-6)
+        self.check_values('float16', 1e-2)
+        self.check_values('int8', 0.05)
+
+    def test_column_values(self):
+        res = mldb.query('SELECT x3 FROM emb_int8 ORDER BY rowName() LIMIT 1')
+        self.assertEqual(res[1][0], 'row0')
+        self.assertLess(abs(res[1][1] - self.rows[0][1][3][1]), 0.05)
+
+    def neighbors(self, name, row):
+        res = mldb.query("SELECT nn_%s({coords: '%s'})[distances] AS *"
+                         % (name, row))
+        return dict(zip(res[0][1:], res[1][1:]))
+
+    def check_recall(self, name, exact_name, min_recall):
+        found = 0
+        expected = 0
+        for i in range(0, NUM_ROWS, 20):
+            exact = self.neighbors(exact_name, 'row%d' % i)
+            approx = self.neighbors(name, 'row%d' % i)
+            self.assertEqual(len(approx), 10)
+            found += len(set(exact) & set(approx))
+            expected += len(exact)
+        self.assertGreaterEqual(found / float(expected), min_recall)
+
+    def test_recall(self):
+        self.check_recall('float16', 'float32', 0.95)
+        self.check_recall('int8', 'float32', 0.9)
+        self.check_recall('int8_pq_hnsw', 'float32_cosine', 0.85)
+
+    def test_pq_reranked_distances_are_exact(self):
+        # With float32 storage, the re-ranked distances are the exact ones
+        exact = self.neighbors('float32', 'row3')
+        approx = self.neighbors('pq', 'row3')
+        self.assertEqual(approx['row3'], 0)
+        for row, dist in approx.items():
+            if row in exact:
+                self.assertAlmostEqual(dist, exact[row], places=5)
+
+    def test_float16_out_of_range(self):
+        ds = mldb.create_dataset({
+            'id' : 'emb_too_big',
+            'type' : 'embedding',
+            'params' : {'storage' : 'float16'}})
+        with self.assertRaises(ResponseException):
+            ds.record_row('row', [['x', 1e6, 0], ['y', 0, 0]])
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,80 @@
+#
+# experiment_parallel_folds_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that running the folds of classifier.experiment in parallel, over
+# materialized input data, gives the same results as running them one after
+# the other over the original query.
+#
+import datetime
+import random
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class ExperimentParallelFoldsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        ds = mldb.create_dataset({'id' : 'toy', 'type' : 'sparse.mutable'})
+        now = datetime.datetime.now()
+        for i in range(2000):
+            label = random.random() < 0.3
+            ds.record_row('u%d' % i, [
+                ['feat1', random.gauss(5 if label else 15, 3), now],
+                ['feat2', random.gauss(-5 if label else 10, 10), now],
+                ['w', random.random() + 0.5, now],
+                ['label', label, now]])
+        ds.commit()
+
+    def run_experiment(self, name, **kwargs):
+        params = {
+            'experimentName' : name,
+            'inputData' : 'SELECT {feat1, feat2} AS features, label, '
+                          'w AS weight FROM toy',
+            'kfold' : 5,
+            'modelFileUrlPattern' : 'file://tmp/parallel_folds_$runid.cls',
+            'algorithm' : 'glz',
+            'mode' : 'boolean',
+            'configuration' : {
+                'glz' : {
+                    'type' : 'glz',
+                    'normalize' : False
+                }
+            },
+            'evalTrain' : True,
+            'keepArtifacts' : False,
+            'runOnCreation' : False
+        }
+        params.update(kwargs)
+        mldb.put('/v1/procedures/' + name, {
+            'type' : 'classifier.experiment',
+            'params' : params
+        })
+        return mldb.post('/v1/procedures/%s/runs' % name).json()['status']
+
+    def test_same_results(self):
+        sequential = self.run_experiment('sequential', foldParallelism=1,
+                                         materializeInputData=False)
+        parallel = self.run_experiment('parallel', foldParallelism=5)
+
+        self.assertEqual(len(parallel['folds']), 5)
+        for s, p in zip(sequential['folds'], parallel['folds']):
+            self.assertEqual(s['fold'], p['fold'])
+            self.assertEqual(s['functionName'].replace('sequential', ''),
+                             p['functionName'].replace('parallel', ''))
+            for results in ['resultsTest', 'resultsTrain']:
+                self.assertAlmostEqual(s[results]['auc'],
+                                       p[results]['auc'], places=5)
+
+        # The intermediate artifacts are removed
+        self.assertFalse(any('parallel_inputData' in ds
+                             for ds in mldb.get('/v1/datasets').json()))
+        self.assertFalse(any(proc.startswith('parallel_')
+                             for proc in mldb.get('/v1/procedures').json()))
+
+    def test_fold_parallelism_validation(self):
+        with self.assertRaises(ResponseException):
+            self.run_experiment('invalid', foldParallelism=0)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -170,6 +170,56 @@ class FastTextTest(MldbUnitTest):
                 ]
             ])
 
+        def test_fasttext_quantized(self):
+            def train(name, quantize):
+                mldb.put("/v1/procedures/trainer_" + name, {
+                    "type": "classifier.train",
+                    "params": {
+                        "trainingData": "SELECT {tokens.*} as features, Theme as label FROM bag_of_words",
+                        "modelFileUrl": "file://tmp/src_fasttext_{}.cls".format(name),
+                        "functionName" : 'classify_' + name,
+                        "algorithm": "my_fasttext",
+                        "mode": "categorical",
+                        "runOnCreation": True,
+                        "configuration": {
+                            "my_fasttext": {
+                                "type": "fasttext",
+                                "verbosity" : 0,
+                                "dims" : 4,
+                                "epoch" : 5,
+                                "quantize": quantize
+                            }
+                        }
+                    }
+                })
+
+            train("float", False)
+            train("quantized", True)
+
+            for word in ['hockey', 'hillary']:
+                query = """
+                    SELECT classify_{}({{features : {{tokenize(lower(' {} '), {{splitChars:' ,.:;«»[]()%!?', quoteChar:'', minTokenLength: 2}}) as tokens}} }}) as *
+                """
+                expected = mldb.query(query.format('float', word))[1][1:]
+                actual = mldb.query(query.format('quantized', word))[1][1:]
+                self.assertEqual(len(actual), len(expected))
+                for a, e in zip(actual, expected):
+                    self.assertAlmostEqual(a, e, delta=0.05)
+
+            # The quantized model reloads from its file
+            mldb.put("/v1/functions/reloaded_quantized", {
+                "type": "classifier",
+                "params": {
+                    "modelFileUrl": "file://tmp/src_fasttext_quantized.cls"
+                }
+            })
+            query = """
+                SELECT {}({{features : {{tokenize(lower(' hockey '), {{splitChars:' ,.:;«»[]()%!?', quoteChar:'', minTokenLength: 2}}) as tokens}} }}) as *
+            """
+            self.assertEqual(
+                mldb.query(query.format('reloaded_quantized')),
+                mldb.query(query.format('classify_quantized')))
+
         def test_fasttext_explain(self):
 
             mldb.log("explain")
@@ -0,0 +1,64 @@
+#
+# feature_hasher_benchmark.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Time the feature_hasher function on wide sparse rows, one row per call
+# and through the batch route, and check that both give the same hashes.
+#
+import random
+import time
+from mldb import mldb, MldbUnitTest, ResponseException
+
+NUM_ROWS = 200
+NUM_COLS = 1000
+VOCABULARY = 100000
+
+class FeatureHasherBenchmark(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        cls.inputs = [
+            {'columns' : {'w%d' % random.randint(0, VOCABULARY) : 1
+                          for _ in range(NUM_COLS)}}
+            for _ in range(NUM_ROWS)]
+
+    def run_mode(self, mode):
+        mldb.put('/v1/functions/hasher_' + mode, {
+            'type' : 'feature_hasher',
+            'params' : {'numBits' : 10, 'mode' : mode}
+        })
+
+        start = time.time()
+        one = [mldb.get('/v1/functions/hasher_%s/application' % mode,
+                        input=input, outputFormat='json').json()
+               for input in self.inputs]
+        single = time.time() - start
+
+        start = time.time()
+        batch = mldb.get('/v1/functions/hasher_%s/batch' % mode,
+                         input=self.inputs).json()
+        batched = time.time() - start
+
+        mldb.log('%s: %d rows of %d columns: %.1f rows/s one at a time, '
+                 '%.1f rows/s batched'
+                 % (mode, NUM_ROWS, NUM_COLS, NUM_ROWS / single,
+                    NUM_ROWS / batched))
+
+        self.assertEqual(batch, one)
+
+    def test_columns(self):
+        self.run_mode('columns')
+
+    def test_columns_and_values(self):
+        self.run_mode('columnsAndValues')
+
+    def test_num_bits_validation(self):
+        with self.assertRaises(ResponseException):
+            mldb.put('/v1/functions/hasher_bad', {
+                'type' : 'feature_hasher',
+                'params' : {'numBits' : 0}
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
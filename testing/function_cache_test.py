@@ -0,0 +1,64 @@
+#
+# function_cache_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Test of the memoization of function outputs (the cacheSize field of a
+# function's configuration).
+#
+
+from mldb import mldb, MldbUnitTest
+
+class FunctionCacheTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.put("/v1/functions/cached", {
+            "type": "sql.expression",
+            "cacheSize": 100,
+            "params": {
+                "expression": "x * 2 AS y"
+            }
+        })
+        mldb.put("/v1/functions/uncached", {
+            "type": "sql.expression",
+            "params": {
+                "expression": "x * 2 AS y"
+            }
+        })
+
+    def stats(self, fn):
+        return mldb.get("/v1/functions/{}/cache".format(fn)).json()
+
+    def test_disabled_by_default(self):
+        self.assertEqual(self.stats('uncached'), {'enabled': False})
+
+    def test_hits(self):
+        before = self.stats('cached')
+        self.assertTrue(before['enabled'])
+        self.assertEqual(before['capacity'], 112)  # rounded up over shards
+
+        query = """
+            SELECT cached({x: value})[y] AS y
+            FROM (SELECT * FROM row_dataset({a: 1, b: 2, c: 1, d: 2, e: 1}))
+            ORDER BY rowName()
+        """
+        expected = [["_rowName", "y"],
+                    ["0", 2], ["1", 4], ["2", 2], ["3", 4], ["4", 2]]
+        self.assertTableResultEquals(mldb.query(query), expected)
+
+        after = self.stats('cached')
+        self.assertEqual(after['hits'] + after['misses'],
+                         before['hits'] + before['misses'] + 5)
+        # Rows may be run in parallel, so two of them can miss on the
+        # same value
+        self.assertGreaterEqual(after['hits'], before['hits'] + 1)
+        self.assertGreater(after['hitRate'], 0)
+
+    def test_timestamps(self):
+        # The same value at a different time gives an output at that time
+        for ts in ['2015-01-01T00:00:00Z', '2016-01-01T00:00:00Z']:
+            res = mldb.get("/v1/query", format="full",
+                           q="SELECT cached({x: 21 @ '%s'})[y] AS y" % ts)
+            self.assertEqual(res.json()[0]['columns'], [['y', 42, ts]])
+
+mldb.run_tests()
@@ -0,0 +1,121 @@
+#
+# geo_index_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Queries whose WHERE clause is a geo_distance() limit or ST_Contains_Point()
+# on two columns find their rows with a spatial index, and must return the
+# same rows as testing each of them.
+#
+import json
+import math
+
+from mldb import mldb, MldbUnitTest
+
+EARTH_MEAN_RADIUS_METERS = 6371008.8
+
+
+def distance(lat1, lon1, lat2, lon2):
+    lat1, lon1, lat2, lon2 = map(math.radians, [lat1, lon1, lat2, lon2])
+    a = math.sin((lat2 - lat1) / 2) ** 2 \
+        + math.cos(lat1) * math.cos(lat2) * math.sin((lon2 - lon1) / 2) ** 2
+    return 2 * math.asin(min(1, math.sqrt(a))) * EARTH_MEAN_RADIUS_METERS
+
+
+class GeoIndexTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.points = {}
+        ds = mldb.create_dataset({'id' : 'points', 'type' : 'sparse.mutable'})
+        for lat in range(-90, 91, 5):
+            for lon in range(-180, 180, 5):
+                name = 'p_{}_{}'.format(lat, lon)
+                cls.points[name] = (lat, lon)
+                ds.record_row(name, [['lat', lat, 0], ['lon', lon, 0]])
+        ds.commit()
+
+        # Rows without a complete point never match geo_distance()
+        ds = mldb.create_dataset({'id' : 'partial', 'type' : 'sparse.mutable'})
+        ds.record_row('both', [['lat', 1, 0], ['lon', 1, 0]])
+        ds.record_row('no_lon', [['lat', 1, 0]])
+        ds.record_row('nothing', [['other', 1, 0]])
+        ds.commit()
+
+    def rows(self, query):
+        res = mldb.query(query)
+        return sorted(r[0] for r in res[1:])
+
+    def check_distance(self, lat, lon, meters):
+        indexed = self.rows(
+            'SELECT 1 FROM points WHERE geo_distance(lat, lon, {}, {}) < {}'
+            .format(lat, lon, meters))
+        scanned = self.rows(
+            'SELECT 1 FROM points WHERE NOT (geo_distance(lat, lon, {}, {}) >= {})'
+            .format(lat, lon, meters))
+        self.assertEqual(indexed, scanned)
+
+        expected = sorted(name for name, p in self.points.items()
+                          if distance(p[0], p[1], lat, lon) < meters)
+        self.assertEqual(indexed, expected)
+        return indexed
+
+    def test_distance(self):
+        rows = self.check_distance(0, 0, 600000)
+        self.assertEqual(rows, ['p_-5_0', 'p_0_-5', 'p_0_0', 'p_0_5', 'p_5_0'])
+
+    def test_antimeridian(self):
+        rows = self.check_distance(2, 178, 800000)
+        self.assertIn('p_0_-180', rows)
+        self.assertIn('p_5_175', rows)
+
+    def test_pole(self):
+        rows = self.check_distance(88, 30, 900000)
+        self.assertIn('p_85_-150', rows)
+        self.assertIn('p_90_0', rows)
+
+    def test_other_forms(self):
+        expected = self.check_distance(45, -73, 1000000)
+        self.assertEqual(self.rows(
+            'SELECT 1 FROM points '
+            'WHERE 1000000 > geo_distance(45, -73, points.lat, points.lon)'),
+            expected)
+        self.assertEqual(self.rows(
+            'SELECT 1 FROM points '
+            'WHERE geo_distance(lat, lon, 45, -73) < 1000000 AND lat > 45'),
+            [r for r in expected if self.points[r][0] > 45])
+
+    def test_reindex_after_change(self):
+        ds = mldb.create_dataset({'id' : 'changing', 'type' : 'sparse.mutable'})
+        ds.record_row('a', [['lat', 0, 0], ['lon', 0, 0]])
+        ds.commit()
+        query = 'SELECT 1 FROM changing WHERE geo_distance(lat, lon, 10, 10) < 10000'
+        self.assertEqual(self.rows(query), [])
+        ds.record_row('b', [['lat', 10, 0], ['lon', 10, 0]])
+        ds.commit()
+        self.assertEqual(self.rows(query), ['b'])
+
+    def test_partial_rows(self):
+        self.assertEqual(self.rows(
+            'SELECT 1 FROM partial WHERE geo_distance(lat, lon, 1, 1) < 1000'),
+            ['both'])
+
+    def test_st_contains(self):
+        # Square that crosses the antimeridian
+        polygon = json.dumps({
+            'type' : 'Polygon',
+            'coordinates' : [[[170, -12], [-170, -12], [-170, 12],
+                              [170, 12], [170, -12]]]
+        })
+        indexed = self.rows(
+            "SELECT 1 FROM points WHERE ST_Contains_Point("
+            "parse_json('{}'), lat, lon)".format(polygon))
+        scanned = self.rows(
+            "SELECT 1 FROM points WHERE NOT NOT ST_Contains_Point("
+            "parse_json('{}'), lat, lon)".format(polygon))
+        self.assertEqual(indexed, scanned)
+        self.assertIn('p_0_-180', indexed)
+        self.assertIn('p_10_175', indexed)
+        self.assertNotIn('p_0_0', indexed)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,79 @@
+#
+# glz_sparse_training_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# The glz classifier trained on the sparse data (sparse: true) gives the
+# same classifier as when it's trained on the dense feature matrix.
+#
+import random
+
+from mldb import mldb, MldbUnitTest
+
+
+class GlzSparseTrainingTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(42)
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(500):
+            cols = []
+            score = 0
+            # 100 words, each of which is in few of the rows
+            for w in random.sample(range(100), 5):
+                cols.append(['w{}'.format(w), 1, 0])
+                score += 1 if w % 2 else -1
+            x = random.random()
+            cols.append(['x', x, 0])
+            score += 4 * (x - 0.5)
+            label = score + random.gauss(0, 1) > 0
+            cols.append(['label', label, 0])
+            ds.record_row('r{}'.format(i), cols)
+        ds.commit()
+
+    def train(self, name, sparse, link='logit', mode='boolean'):
+        mldb.post('/v1/procedures', {
+            'type' : 'classifier.train',
+            'params' : {
+                'trainingData' :
+                    'SELECT {* EXCLUDING (label)} AS features, label FROM ds',
+                'algorithm' : 'glz',
+                'configuration' : {
+                    'glz' : {
+                        'type' : 'glz',
+                        'link_function' : link,
+                        'sparse' : sparse,
+                        'normalize' : False
+                    }
+                },
+                'mode' : mode,
+                'modelFileUrl' : 'file://tmp/glz_sparse_{}.cls'.format(name),
+                'functionName' : name,
+                'runOnCreation' : True
+            }
+        })
+
+    def scores(self, name):
+        res = mldb.query("""
+            SELECT {}({{features: {{* EXCLUDING (label)}}}})[score] AS score
+            FROM ds ORDER BY rowName()
+        """.format(name))
+        return [r[1] for r in res[1:]]
+
+    def test_same_as_dense(self):
+        self.train('dense_cls', False)
+        self.train('sparse_cls', True)
+        dense = self.scores('dense_cls')
+        sparse = self.scores('sparse_cls')
+        self.assertEqual(len(dense), 500)
+        for d, s in zip(dense, sparse):
+            self.assertAlmostEqual(d, s, places=2)
+
+    def test_regression(self):
+        self.train('dense_reg', False, 'linear', 'regression')
+        self.train('sparse_reg', True, 'linear', 'regression')
+        for d, s in zip(self.scores('dense_reg'), self.scores('sparse_reg')):
+            self.assertAlmostEqual(d, s, places=2)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,311 @@
+#
+# import_parquet_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Tests for the import.parquet procedure.  The files are written by the
+# minimal Parquet writer below, so that the test doesn't need pyarrow.
+#
+import gzip
+import struct
+import tempfile
+import datetime
+from mldb import mldb, MldbUnitTest, ResponseException
+
+# Thrift compact protocol types
+BOOL, I32, I64, BINARY, LIST, STRUCT = 1, 5, 6, 8, 9, 12
+
+# Parquet physical types
+BOOLEAN, INT32, INT64, DOUBLE, BYTE_ARRAY = 0, 1, 2, 5, 6
+
+def varint(v):
+    out = bytearray()
+    while True:
+        b = v & 0x7f
+        v >>= 7
+        if v:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+def zigzag(v):
+    return ((v << 1) ^ (v >> 63)) & 0xffffffffffffffff
+
+def thrift_value(ftype, value):
+    if ftype in (I32, I64):
+        return varint(zigzag(value))
+    if ftype == BINARY:
+        if isinstance(value, str):
+            value = value.encode('utf-8')
+        return varint(len(value)) + value
+    if ftype == STRUCT:
+        return thrift_struct(value)
+    if ftype == LIST:
+        etype, items = value
+        if len(items) < 15:
+            out = bytes([len(items) << 4 | etype])
+        else:
+            out = bytes([0xf0 | etype]) + varint(len(items))
+        return out + b''.join(thrift_value(etype, i) for i in items)
+    raise Exception('unknown thrift type')
+
+def thrift_struct(fields):
+    """Encode a struct from a list of (id, type, value), skipping None"""
+    out = bytearray()
+    last = 0
+    for fid, ftype, value in fields:
+        if value is None:
+            continue
+        t = (1 if value else 2) if ftype == BOOL else ftype
+        if 0 < fid - last <= 15:
+            out.append((fid - last) << 4 | t)
+        else:
+            out.append(t)
+            out += varint(zigzag(fid))
+        last = fid
+        if ftype != BOOL:
+            out += thrift_value(ftype, value)
+    out.append(0)
+    return bytes(out)
+
+def bit_pack(values, width):
+    """Bit-packed run of the RLE / bit-packed hybrid encoding"""
+    values = list(values) + [0] * (-len(values) % 8)
+    bits = 0
+    for i, v in enumerate(values):
+        bits |= v << (i * width)
+    return (varint((len(values) // 8) << 1 | 1)
+            + bits.to_bytes(len(values) * width // 8, 'little'))
+
+def plain(ptype, values, stat=False):
+    if ptype == BOOLEAN:
+        return bit_pack(values, 1)[1:] if not stat else bytes([values[0]])
+    if ptype == INT32:
+        return b''.join(struct.pack('<i', v) for v in values)
+    if ptype == INT64:
+        return b''.join(struct.pack('<q', v) for v in values)
+    if ptype == DOUBLE:
+        return b''.join(struct.pack('<d', v) for v in values)
+    out = b''
+    for v in values:
+        v = v.encode('utf-8')
+        out += v if stat else struct.pack('<I', len(v)) + v
+    return out
+
+def snappy(data):
+    """Snappy block made only of literals"""
+    out = varint(len(data))
+    for i in range(0, len(data), 65536):
+        chunk = data[i:i + 65536]
+        out += bytes([61 << 2]) + struct.pack('<H', len(chunk) - 1) + chunk
+    return out
+
+def compress(codec, data):
+    return { 0: lambda d: d, 1: snappy, 2: gzip.compress }[codec](data)
+
+def write_parquet(path, columns, row_groups, codec=0):
+    """Write a flat Parquet file.  Columns are tuples of (name, physical
+       type, optional, converted type, dictionary encoded), and each row
+       group is a list of rows."""
+    out = bytearray(b'PAR1')
+    groups = []
+    first_row = 0
+    for rows in row_groups:
+        chunks = []
+        for c, (name, ptype, optional, converted, use_dict) in \
+                enumerate(columns):
+            values = [r[c] for r in rows]
+            present = [v for v in values if v is not None]
+            offset = len(out)
+            dict_offset = None
+
+            def page(page_type, header_id, header, data):
+                body = compress(codec, data)
+                out.extend(thrift_struct([
+                    (1, I32, page_type), (2, I32, len(data)),
+                    (3, I32, len(body)), (header_id, STRUCT, header)]))
+                out.extend(body)
+
+            if use_dict:
+                dictionary = sorted(set(present))
+                dict_offset = len(out)
+                page(2, 7, [(1, I32, len(dictionary)), (2, I32, 0)],
+                     plain(ptype, dictionary))
+                width = max(1, (len(dictionary) - 1).bit_length())
+                data = bytes([width]) + bit_pack(
+                    [dictionary.index(v) for v in present], width)
+                encoding = 8
+            else:
+                data = plain(ptype, present)
+                encoding = 0
+
+            if optional:
+                levels = bit_pack([int(v is not None) for v in values], 1)
+                data = struct.pack('<I', len(levels)) + levels + data
+
+            data_offset = len(out)
+            page(0, 5, [(1, I32, len(values)), (2, I32, encoding),
+                        (3, I32, 3), (4, I32, 3)], data)
+
+            stats = [(3, I64, len(values) - len(present))]
+            if present:
+                stats += [(5, BINARY, plain(ptype, [max(present)], True)),
+                          (6, BINARY, plain(ptype, [min(present)], True))]
+            meta = [(1, I32, ptype), (2, LIST, (I32, [encoding, 3])),
+                    (3, LIST, (BINARY, [name])), (4, I32, codec),
+                    (5, I64, len(values)), (6, I64, len(out) - offset),
+                    (7, I64, len(out) - offset), (9, I64, data_offset),
+                    (11, I64, dict_offset), (12, STRUCT, stats)]
+            chunks.append([(2, I64, offset), (3, STRUCT, meta)])
+        groups.append([(1, LIST, (STRUCT, chunks)),
+                       (2, I64, len(out)), (3, I64, len(rows))])
+        first_row += len(rows)
+
+    schema = [[(4, BINARY, 'schema'), (5, I32, len(columns))]]
+    for name, ptype, optional, converted, use_dict in columns:
+        schema.append([(1, I32, ptype), (3, I32, int(optional)),
+                       (4, BINARY, name), (6, I32, converted)])
+    footer = thrift_struct([(1, I32, 1), (2, LIST, (STRUCT, schema)),
+                            (3, I64, first_row),
+                            (4, LIST, (STRUCT, groups))])
+    out += footer + struct.pack('<I', len(footer)) + b'PAR1'
+    with open(path, 'wb') as f:
+        f.write(out)
+
+
+COLUMNS = [
+    ('id', INT64, False, None, False),
+    ('name', BYTE_ARRAY, True, 0, True),         # UTF8, dictionary encoded
+    ('score', DOUBLE, True, None, False),
+    ('flag', BOOLEAN, False, None, False),
+    ('day', INT32, False, 6, False),             # DATE
+]
+
+def make_rows(first, count):
+    return [(i, None if i % 3 == 0 else 'name' + str(i % 4),
+             None if i % 5 == 0 else i / 2.0, i % 2 == 1, 17000 + i)
+            for i in range(first, first + count)]
+
+# Three row groups of 10 rows each
+ROW_GROUPS = [make_rows(0, 10), make_rows(10, 10), make_rows(20, 10)]
+
+
+class ImportParquetTest(MldbUnitTest):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.files = {}
+        for codec in (0, 1, 2):
+            f = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp',
+                                            suffix='.parquet')
+            write_parquet(f.name, COLUMNS, ROW_GROUPS, codec)
+            cls.files[codec] = f
+
+    def run_import(self, dataset, codec=0, **params):
+        params.update({
+            'dataFileUrl' : 'file://' + self.files[codec].name,
+            'outputDataset' : { 'id' : dataset, 'type' : 'tabular' },
+            'runOnCreation' : True
+        })
+        res = mldb.post('/v1/procedures', {
+            'type' : 'import.parquet',
+            'params' : params
+        }).json()
+        return res['status']['firstRun']['status']
+
+    def test_select_star(self):
+        status = self.run_import('pq_star')
+        self.assertEqual(status['rowCount'], 30)
+        self.assertEqual(status['numRowGroups'], 3)
+        self.assertEqual(status['numRowGroupsSkipped'], 0)
+
+        res = mldb.query("""
+            SELECT id, name, score, flag, day FROM pq_star
+            WHERE rowName() IN ('1', '4', '16') ORDER BY id""")
+        day = lambda n: (datetime.datetime(1970, 1, 1)
+                         + datetime.timedelta(days=17000 + n)) \
+            .strftime('%Y-%m-%dT%H:%M:%SZ')
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'id', 'name', 'score', 'flag', 'day'],
+            ['1', 0, None, None, 0, { 'ts' : day(0) }],
+            ['4', 3, None, 1.5, 1, { 'ts' : day(3) }],
+            ['16', 15, None, None, 1, { 'ts' : day(15) }]
+        ])
+
+        res = mldb.query("SELECT name FROM pq_star WHERE id = 10")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'name'],
+            ['11', 'name2']
+        ])
+
+    def test_codecs(self):
+        for codec in (0, 1, 2):
+            status = self.run_import('pq_codec_%d' % codec, codec)
+            self.assertEqual(status['rowCount'], 30)
+        for codec in (1, 2):
+            res = mldb.query("""
+                SELECT count(*) FROM pq_codec_0 AS a
+                JOIN pq_codec_%d AS b ON a.rowName() = b.rowName()
+                WHERE a.id = b.id AND a.score IS NOT DISTINCT FROM b.score
+                  AND a.name IS NOT DISTINCT FROM b.name
+                  AND a.day = b.day AND a.flag = b.flag""" % codec)
+            self.assertEqual(res[1][1], 30)
+
+    def test_row_group_pruning(self):
+        status = self.run_import('pq_pruned', where='id >= 22 AND id < 25',
+                                 select='id, score')
+        self.assertEqual(status['rowCount'], 3)
+        self.assertEqual(status['numRowGroupsSkipped'], 2)
+
+        res = mldb.query("SELECT * FROM pq_pruned ORDER BY id")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'id', 'score'],
+            ['23', 22, 11],
+            ['24', 23, 11.5],
+            ['25', 24, 12]
+        ])
+
+        # Row groups whose values are all null can't match a comparison
+        status = self.run_import('pq_pruned2', where="name = 'name9'")
+        self.assertEqual(status['rowCount'], 0)
+        self.assertEqual(status['numRowGroupsSkipped'], 3)
+
+        # The statistics can't rule out any row group here
+        status = self.run_import('pq_pruned3', where="name IS NULL")
+        self.assertEqual(status['rowCount'], 10)
+        self.assertEqual(status['numRowGroupsSkipped'], 0)
+
+    def test_offset_and_limit(self):
+        status = self.run_import('pq_limit', offset=12, limit=5)
+        self.assertEqual(status['rowCount'], 5)
+        self.assertEqual(status['numRowGroupsSkipped'], 2)
+        res = mldb.query("SELECT min(id), max(id) FROM pq_limit")
+        self.assertEqual(res[1][1:], [12, 16])
+
+    def test_named_and_timestamp(self):
+        self.run_import('pq_named', select='score',
+                        named="'row' + CAST (id AS STRING)",
+                        timestamp='day', where='id = 7')
+        res = mldb.query("SELECT score FROM pq_named")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'score'],
+            ['row7', 3.5]
+        ])
+
+    def test_not_parquet(self):
+        f = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp')
+        f.write(b'a,b\n1,2\n')
+        f.flush()
+        with self.assertRaisesRegex(ResponseException,
+                                    'not in Parquet format'):
+            mldb.post('/v1/procedures', {
+                'type' : 'import.parquet',
+                'params' : {
+                    'dataFileUrl' : 'file://' + f.name,
+                    'outputDataset' : 'pq_bad',
+                    'runOnCreation' : True
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
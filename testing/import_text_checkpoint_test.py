@@ -0,0 +1,126 @@
+#
+# import_text_checkpoint_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# A run of import.text saves checkpoints as it goes, and a run that fails
+# can be resumed from the last of them rather than from the beginning.
+#
+import os
+import tempfile
+from mldb import mldb, MldbUnitTest, ResponseException
+
+NUM_LINES = 300000
+FAIL_AT_LINE = 250000
+
+
+class ImportTextCheckpointTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.dir = tempfile.mkdtemp(dir='build/x86_64/tmp')
+        cls.filename = os.path.join(cls.dir, 'lines.csv')
+        with open(cls.filename, 'w') as f:
+            f.write('a,b\n')
+            for i in range(NUM_LINES):
+                f.write('{},{}\n'.format(i, i * 2))
+
+    def create_procedure(self, name, output, select):
+        mldb.put('/v1/procedures/' + name, {
+            'type' : 'import.text',
+            'params' : {
+                'dataFileUrl' : 'file://' + self.filename,
+                'outputDataset' : output,
+                'select' : select
+            }
+        })
+
+    def run_procedure(self, name, checkpoints, resume):
+        return mldb.post('/v1/procedures/{}/runs'.format(name), {
+            'checkpoint' : {
+                'url' : 'file://' + checkpoints,
+                'intervalSeconds' : 0.001,
+                'resume' : resume
+            }
+        }).json()['status']
+
+    def checkpoint_files(self, checkpoints):
+        return sorted(os.listdir(checkpoints))
+
+    def check_output(self, output):
+        res = mldb.query('SELECT count(*), sum(a), sum(b), min(c), max(c) '
+                         'FROM ' + output)
+        total = NUM_LINES * (NUM_LINES - 1) // 2
+        self.assertEqual(res[1][1:], [NUM_LINES, total, total * 2, 1, 1])
+
+    def test_resume_after_failure(self):
+        checkpoints = os.path.join(self.dir, 'resume')
+
+        # Fails part of the way through
+        self.create_procedure(
+            'failing', 'resumed',
+            "a, b, CASE WHEN a = {} THEN parse_json('{{') ELSE 1 END AS c"
+            .format(FAIL_AT_LINE))
+        with self.assertRaises(ResponseException):
+            self.run_procedure('failing', checkpoints, False)
+
+        files = self.checkpoint_files(checkpoints)
+        self.assertEqual(len([f for f in files
+                              if f.startswith('checkpoint-')]), 1)
+        self.assertGreater(len([f for f in files if f.startswith('part-')]),
+                           1)
+
+        # Carries on from where the last checkpoint left off
+        self.create_procedure('fixed', 'resumed', 'a, b, 1 AS c')
+        status = self.run_procedure('fixed', checkpoints, True)
+        self.assertGreater(status['resumedFromLine'], 0)
+        self.assertLessEqual(status['resumedFromLine'], FAIL_AT_LINE)
+        self.assertEqual(status['rowCount'], NUM_LINES)
+        self.check_output('resumed')
+
+        # The row names are still the line numbers
+        res = mldb.query("SELECT a FROM resumed WHERE rowName() = '{}'"
+                         .format(NUM_LINES + 1))
+        self.assertEqual(res[1][1], NUM_LINES - 1)
+
+        # Once it has succeeded, the checkpoints are gone
+        self.assertEqual(self.checkpoint_files(checkpoints), [])
+
+    def test_without_resume_starts_again(self):
+        checkpoints = os.path.join(self.dir, 'restart')
+
+        self.create_procedure(
+            'failing2', 'restarted',
+            "a, b, CASE WHEN a = {} THEN parse_json('{{') ELSE 1 END AS c"
+            .format(FAIL_AT_LINE))
+        with self.assertRaises(ResponseException):
+            self.run_procedure('failing2', checkpoints, False)
+
+        self.create_procedure('fixed2', 'restarted', 'a, b, 1 AS c')
+        status = self.run_procedure('fixed2', checkpoints, False)
+        self.assertEqual(status['resumedFromLine'], 0)
+        self.assertGreater(status['checkpointsSaved'], 0)
+        self.check_output('restarted')
+        self.assertEqual(self.checkpoint_files(checkpoints), [])
+
+    def test_resume_without_checkpoint(self):
+        checkpoints = os.path.join(self.dir, 'empty')
+        self.create_procedure('fresh', 'fresh', 'a, b, 1 AS c')
+        status = self.run_procedure('fresh', checkpoints, True)
+        self.assertEqual(status['resumedFromLine'], 0)
+        self.check_output('fresh')
+
+    def test_multi_lines_not_supported(self):
+        mldb.put('/v1/procedures/multi', {
+            'type' : 'import.text',
+            'params' : {
+                'dataFileUrl' : 'file://' + self.filename,
+                'outputDataset' : 'multi',
+                'allowMultiLines' : True
+            }
+        })
+        with self.assertRaises(ResponseException):
+            self.run_procedure('multi', os.path.join(self.dir, 'multi'),
+                               False)
+
+if __name__ == '__main__':
+    mldb.run_tests()
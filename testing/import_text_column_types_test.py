@@ -0,0 +1,88 @@
+#
+# import_text_column_types_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Test of the columnTypes parameter of import.text.
+#
+import tempfile
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class ImportTextColumnTypesTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.file = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp',
+                                               suffix='.csv', mode='w')
+        cls.file.write('id,i,n,t,s\n'
+                       '007,1,2,2016-01-02T03:04:05Z,abc\n'
+                       '008,-18446744073,2.5,2016-01-03,"12"\n'
+                       '009,,-3e2,,\n'
+                       '010,18446744073709551615,"4",2016-01-04T00:00:00Z,x\n')
+        cls.file.flush()
+
+    def run_import(self, dataset, columnTypes, **params):
+        params.update({
+            'dataFileUrl' : 'file://' + self.file.name,
+            'outputDataset' : dataset,
+            'columnTypes' : columnTypes,
+            'runOnCreation' : True
+        })
+        return mldb.post('/v1/procedures', {
+            'type' : 'import.text',
+            'params' : params
+        }).json()['status']['firstRun']['status']
+
+    def test_types(self):
+        self.run_import('typed', {
+            'id' : 'string', 'i' : 'integer', 'n' : 'number',
+            't' : 'timestamp', 's' : 'string'
+        })
+        res = mldb.query('SELECT id, i, n, t, s, '
+                         'n IS FLOAT AS nf, t IS TIMESTAMP AS tt, '
+                         's IS STRING AS ss FROM typed ORDER BY rowName()')
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'id', 'i', 'n', 't', 's', 'nf', 'tt', 'ss'],
+            ['2', '007', 1, 2, {'ts' : '2016-01-02T03:04:05Z'}, 'abc',
+             True, True, True],
+            ['3', '008', -18446744073, 2.5, {'ts' : '2016-01-03T00:00:00Z'}, '12',
+             True, True, True],
+            ['4', '009', None, -300, None, None, True, False, False],
+            ['5', '010', 18446744073709551615, 4, {'ts' : '2016-01-04T00:00:00Z'}, 'x',
+             True, True, True]
+        ])
+
+    def test_auto(self):
+        # Undeclared columns are detected as before
+        self.run_import('untyped', {'i' : 'auto'})
+        res = mldb.query('SELECT id, s FROM untyped ORDER BY rowName()')
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'id', 's'],
+            ['2', 7, 'abc'],
+            ['3', 8, 12],
+            ['4', 9, None],
+            ['5', 10, 'x']
+        ])
+
+    def test_bad_values(self):
+        status = self.run_import('bad', {'s' : 'integer', 't' : 'number'},
+                                 ignoreBadLines=True)
+        self.assertEqual(status['numLineErrors'], 3)
+        res = mldb.query('SELECT s, t FROM bad')
+        self.assertTableResultEquals(res, [
+            ['_rowName', 's', 't'],
+            ['4', None, None]
+        ])
+
+        with self.assertRaisesRegex(ResponseException, 'not an integer'):
+            self.run_import('bad2', {'s' : 'integer'})
+
+    def test_unknown_column(self):
+        with self.assertRaisesRegex(ResponseException, 'columnTypes'):
+            self.run_import('unknown', {'nope' : 'integer'})
+
+        with self.assertRaises(ResponseException):
+            self.run_import('unknown2', {'i' : 'categorical'})
+
+if __name__ == '__main__':
+    mldb.run_tests()
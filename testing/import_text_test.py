@@ -173,6 +173,43 @@ class ImportTextTest(MldbUnitTest):
             ['2', 1, 2]
         ])
 
+    def test_long_lines(self):
+        """
+        Fields that cross the 64 character blocks that lines are indexed in
+        """
+        long_str = 'x' * 61
+        long_quoted = '"' + 'y' * 60 + '""' + 'z' * 70 + '"'
+        long_utf8 = 'w' * 63 + '\u00e9' + 'w' * 10
+        lines = [
+            'a,b,c,d',
+            ','.join([long_str, long_quoted, long_utf8, '123456789012345678']),
+            ','.join(['', long_quoted, '-42', '1234567890123456789']),
+            ','.join([long_utf8, '', long_str, '7']),
+        ]
+
+        tmp_file = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp')
+        tmp_file.write(('\n'.join(lines) + '\n').encode('utf-8'))
+        tmp_file.flush()
+
+        mldb.post('/v1/procedures', {
+            'type' : 'import.text',
+            'params' : {
+                'runOnCreation' : True,
+                'dataFileUrl' : 'file://' + tmp_file.name,
+                'outputDataset' : 'long_lines_ds',
+                'encoding' : 'utf-8'
+            }
+        })
+
+        quoted_value = 'y' * 60 + '"' + 'z' * 70
+        res = mldb.query("SELECT a, b, c, d FROM long_lines_ds "
+                         "ORDER BY rowName()")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'a', 'b', 'c', 'd'],
+            ['2', long_str, quoted_value, long_utf8, 123456789012345678],
+            ['3', None, quoted_value, -42, '1234567890123456789'],
+            ['4', long_utf8, None, long_str, 7]
+        ])
 
 if __name__ == '__main__':
     mldb.run_tests()
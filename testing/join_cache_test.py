@@ -0,0 +1,82 @@
+#
+# join_cache_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that the rows of a joined dataset are reused by the same join of
+# the same data, and that only the side that changed is read again.
+#
+
+from mldb import mldb, MldbUnitTest
+
+class JoinCacheTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        left = mldb.create_dataset({'id' : 'left', 'type' : 'sparse.mutable'})
+        left.record_row('l1', [['k', 1, 0], ['a', 'x', 0]])
+        left.record_row('l2', [['k', 2, 0], ['a', 'y', 0]])
+        left.record_row('l3', [['k', 5, 0], ['a', 'z', 0]])
+        left.commit()
+
+        right = mldb.create_dataset({'id' : 'right', 'type' : 'sparse.mutable'})
+        right.record_row('r1', [['k', 1, 0], ['b', 10, 0]])
+        right.record_row('r2', [['k', 2, 0], ['b', 20, 0]])
+        right.commit()
+
+    def get_stats(self):
+        return mldb.get('/v1/queryCache').json()['joins']
+
+    def make_join(self, name, qualification='JOIN_INNER'):
+        mldb.put('/v1/datasets/' + name, {
+            'type' : 'joined',
+            'params' : {
+                'left' : 'left',
+                'right' : 'right',
+                'on' : 'left.k = right.k',
+                'qualification' : qualification
+            }
+        })
+
+    def get_rows(self, name):
+        return mldb.query("SELECT * FROM " + name + " ORDER BY rowName()")
+
+    def test_same_join_is_reused(self):
+        self.make_join('j1')
+        expected = self.get_rows('j1')
+
+        before = self.get_stats()
+        self.make_join('j2')
+        after = self.get_stats()
+
+        self.assertEqual(after['hits'] - before['hits'], 1)
+        self.assertEqual(after['misses'], before['misses'])
+        self.assertEqual(self.get_rows('j2'), expected)
+
+    def test_changed_side_is_read_again(self):
+        self.make_join('j3', 'JOIN_LEFT')
+        self.assertEqual(len(self.get_rows('j3')) - 1, 3)
+
+        # Changing the right side leaves the left side cached
+        mldb.post('/v1/datasets/right/rows', {
+            'rowName' : 'r3',
+            'columns' : [['k', 5, 0], ['b', 50, 0]]
+        })
+        mldb.post('/v1/datasets/right/commit')
+
+        before = self.get_stats()
+        self.make_join('j4', 'JOIN_LEFT')
+        after = self.get_stats()
+
+        self.assertEqual(after['incremental'] - before['incremental'], 1)
+        self.assertEqual(after['misses'], before['misses'])
+
+        res = mldb.query("""
+            SELECT "left.a", "right.b" FROM j4 ORDER BY "left.a"
+        """)
+        self.assertEqual(res, [['_rowName', 'left.a', 'right.b'],
+                               ['[l1]-[r1]', 'x', 10],
+                               ['[l2]-[r2]', 'y', 20],
+                               ['[l3]-[r3]', 'z', 50]])
+
+if __name__ == '__main__':
+    mldb.run_tests()
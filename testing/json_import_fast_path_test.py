@@ -0,0 +1,112 @@
+#
+# json_import_fast_path_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# The import.json procedure parses lines with a fast parser, falling back
+# to the general one.  Check that both give the same values, and that
+# keys that a select doesn't need are skipped.
+#
+import json
+import tempfile
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+LINES = [
+    '{"a": 1, "b": -2, "c": 3.5, "d": -0.25e-3, "e": 1E10}',
+    '{"big": 9223372036854775807, "bigger": 9223372036854775808, '
+    '"small": -9223372036854775808, "smaller": -9223372036854775809}',
+    '{"s": "plain", "esc": "q\\"b\\\\s\\/n\\nt\\tu\\u00e9\\ud83d\\ude00"}',
+    '{"utf8": "héllo wörld, this is longer than sixteen bytes"}',
+    '{"t": true, "f": false, "n": null, "empty": "", "o": {}, "l": []}',
+    '{"nested": {"x": {"y": [1, 2, {"z": "deep"}]}}, "after": 1}',
+    '{"arr": [1, 2, 3, false, 5.25, "abc"], "objs": [{"a": 1}, {"b": 2}]}',
+    '  {"spaces" :  [ 1 , "two" ] }  ',
+    '[1, "x", {"y": 2}]',
+    '{"dup": 1, "dup": 2}',
+    '{"key with \\"quotes\\"": "and } brackets ] inside"}',
+]
+
+class JsonImportFastPathTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.file = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp',
+                                               suffix='.json', mode='w')
+        cls.file.write('\n'.join(LINES) + '\n')
+        cls.file.flush()
+
+    def run_import(self, dataset, **params):
+        params.update({
+            'dataFileUrl' : 'file://' + self.file.name,
+            'outputDataset' : dataset,
+            'runOnCreation' : True
+        })
+        return mldb.post('/v1/procedures', {
+            'type' : 'import.json',
+            'params' : params
+        }).json()['status']['firstRun']['status']
+
+    def sparse(self, query):
+        res = mldb.get('/v1/query', q=query, format='sparse',
+                       rowNames=False).json()
+        return sorted(json.dumps(c) for c in res[0]) if res else []
+
+    def check_same_as_parse_json(self, arrays):
+        dataset = 'json_fast_' + arrays
+        status = self.run_import(dataset, arrays=arrays)
+        self.assertEqual(status['rowCount'], len(LINES))
+        for i, line in enumerate(LINES):
+            expected = self.sparse(
+                "SELECT parse_json('%s', {arrays: '%s'}) AS *"
+                % (line.replace("'", "''"), arrays))
+            self.assertEqual(
+                self.sparse("SELECT * FROM %s WHERE rowName() = '%d'"
+                            % (dataset, i + 1)),
+                expected, line)
+
+    def test_parse_arrays(self):
+        self.check_same_as_parse_json('parse')
+
+    def test_encode_arrays(self):
+        self.check_same_as_parse_json('encode')
+
+    def test_projection(self):
+        self.run_import('json_fast_proj', select='a, nested.x.y, after',
+                        where='after IS NOT NULL OR a IS NOT NULL')
+        res = mldb.query('SELECT * FROM json_fast_proj ORDER BY rowName()')
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'a', 'after', 'nested.x.y.0', 'nested.x.y.1',
+             'nested.x.y.2.z'],
+            ['1', 1, None, None, None, None],
+            ['6', None, 1, 1, 2, 'deep']
+        ])
+
+    def test_bad_lines_fall_back(self):
+        f = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp', mode='w')
+        f.write('{"a": 1}\n{"a": 2} x\n{"a": [1,]}\n{"a": 4}\n')
+        f.flush()
+        status = mldb.post('/v1/procedures', {
+            'type' : 'import.json',
+            'params' : {
+                'dataFileUrl' : 'file://' + f.name,
+                'outputDataset' : 'json_fast_bad',
+                'ignoreBadLines' : True,
+                'runOnCreation' : True
+            }
+        }).json()['status']['firstRun']['status']
+        self.assertEqual(status['rowCount'], 2)
+        self.assertEqual(status['numLineErrors'], 2)
+
+        with self.assertRaisesRegex(ResponseException,
+                                    'extra characters at end of line'):
+            mldb.post('/v1/procedures', {
+                'type' : 'import.json',
+                'params' : {
+                    'dataFileUrl' : 'file://' + f.name,
+                    'outputDataset' : 'json_fast_bad2',
+                    'runOnCreation' : True
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,85 @@
+#
+# list_files_parallel_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# The list.files procedure lists each directory on its own, concurrently,
+# and can pick up only the new files when run incrementally.
+#
+import os
+import tempfile
+import time
+from mldb import mldb, MldbUnitTest
+
+
+class ListFilesParallelTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.root = tempfile.mkdtemp(dir='build/x86_64/tmp')
+        cls.files = []
+        for d in range(10):
+            for sub in range(3):
+                path = os.path.join(cls.root, 'd%d' % d, 's%d' % sub)
+                os.makedirs(path)
+                for f in range(5):
+                    name = os.path.join(path, 'f%d.txt' % f)
+                    with open(name, 'w') as fd:
+                        fd.write('x' * f)
+                    cls.files.append(name)
+        # One at the root too
+        name = os.path.join(cls.root, 'top.txt')
+        open(name, 'w').close()
+        cls.files.append(name)
+
+    def list_files(self, output, **params):
+        params.update({
+            'path' : 'file://' + self.root,
+            'outputDataset' : output,
+            'runOnCreation' : True
+        })
+        return mldb.post('/v1/procedures', {
+            'type' : 'list.files',
+            'params' : params
+        }).json()['status']['firstRun']['status']
+
+    def listed(self, output):
+        res = mldb.query('SELECT uri FROM {} ORDER BY uri'.format(output))
+        return sorted(r[1] for r in res[1:])
+
+    def test_all_files_are_listed(self):
+        for threads in [1, 4, 32]:
+            output = 'all%d' % threads
+            status = self.list_files(output, numListingThreads=threads)
+            self.assertEqual(self.listed(output),
+                             sorted('file://' + f for f in self.files))
+            self.assertEqual(status['numFilesRecorded'], len(self.files))
+            self.assertEqual(status['numDirectoriesListed'], 41)
+
+    def test_max_depth(self):
+        self.list_files('depth1', maxDepth=1)
+        self.assertEqual(self.listed('depth1'),
+                         ['file://' + os.path.join(self.root, 'top.txt')])
+
+    def test_incremental(self):
+        output = {'id' : 'incr', 'type' : 'sparse.mutable'}
+        status = self.list_files(output, incremental=True)
+        self.assertEqual(status['numFilesRecorded'], len(self.files))
+
+        # Nothing new, nothing recorded
+        status = self.list_files(output, incremental=True)
+        self.assertEqual(status['numFilesRecorded'], 0)
+
+        # Modification times have a resolution of a second
+        time.sleep(1.1)
+        name = os.path.join(self.root, 'd3', 'new.txt')
+        with open(name, 'w') as fd:
+            fd.write('new')
+        try:
+            status = self.list_files(output, incremental=True)
+            self.assertEqual(status['numFilesRecorded'], 1)
+            self.assertEqual(len(self.listed('incr')), len(self.files) + 1)
+        finally:
+            os.remove(name)
+
+if __name__ == '__main__':
+    mldb.run_tests()
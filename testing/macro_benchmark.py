@@ -0,0 +1,251 @@
+#
+# macro_benchmark.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# End to end benchmarks over synthetic data: CSV import, freezing into a
+# tabular dataset, scans, group-bys, joins, classifier training and
+# scoring, embedding neighbours and REST function latency.  The data comes
+# from generators with a fixed seed, so runs of different versions can be
+# compared.
+#
+# The results are written as JSON to $MLDB_BENCHMARK_OUTPUT (default
+# tmp/macro_benchmark.json); compare two of them with
+# compare_benchmarks.py.  $MLDB_BENCHMARK_SCALE multiplies the number of
+# rows (default 1, which is 100000 rows).  A single scenario can be run
+# with eg ARGS=MacroBenchmark.test_joins.
+#
+import json
+import math
+import os
+import random
+import socket
+import time
+from mldb import mldb, MldbUnitTest
+
+SEED = 12345
+SCALE = float(os.environ.get('MLDB_BENCHMARK_SCALE', '1'))
+NUM_ROWS = max(1000, int(100000 * SCALE))
+NUM_CATEGORIES = 50
+NUM_FEATURES = 8
+REPEATS = 3
+OUTPUT = os.environ.get('MLDB_BENCHMARK_OUTPUT', 'tmp/macro_benchmark.json')
+CSV_FILE = 'tmp/macro_benchmark_%d.csv' % NUM_ROWS
+
+
+def generate_csv(filename, num_rows, seed):
+    """Write the synthetic table: a category, a few numeric features, a
+    label that depends on them and some text."""
+    rng = random.Random(seed)
+    weights = [rng.uniform(-1, 1) for _ in range(NUM_FEATURES)]
+    words = ['w%d' % i for i in range(1000)]
+    features = ['x%d' % i for i in range(NUM_FEATURES)]
+    with open(filename, 'w') as f:
+        f.write(','.join(['id', 'category'] + features + ['label', 'text'])
+                + '\n')
+        for i in range(num_rows):
+            x = [rng.gauss(0, 1) for _ in range(NUM_FEATURES)]
+            score = sum(w * v for w, v in zip(weights, x))
+            label = 1 if rng.random() < 1 / (1 + math.exp(-score)) else 0
+            text = ' '.join(rng.choice(words) for _ in range(5))
+            f.write('%d,c%d,%s,%d,%s\n'
+                    % (i, rng.randrange(NUM_CATEGORIES),
+                       ','.join('%.6f' % v for v in x), label, text))
+
+
+class MacroBenchmark(MldbUnitTest):  # noqa
+
+    results = {}
+
+    @classmethod
+    def setUpClass(cls):
+        if not os.path.exists(CSV_FILE):
+            generate_csv(CSV_FILE, NUM_ROWS, SEED)
+
+        # Every scenario reads the imported table, so it's imported here
+        start = time.time()
+        mldb.put('/v1/procedures/import_bench_csv', {
+            'type' : 'import.text',
+            'params' : {
+                'dataFileUrl' : 'file://' + CSV_FILE,
+                'outputDataset' : {'id' : 'bench_csv', 'type' : 'tabular'},
+                'runOnCreation' : True
+            }
+        })
+        cls.record('csv_import', time.time() - start, NUM_ROWS)
+
+    @classmethod
+    def tearDownClass(cls):
+        output = {
+            'benchmark': 'macro_benchmark',
+            'date': time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime()),
+            'host': socket.gethostname(),
+            'seed': SEED,
+            'rows': NUM_ROWS,
+            'results': cls.results
+        }
+        with open(OUTPUT, 'w') as f:
+            json.dump(output, f, indent=2, sort_keys=True)
+        mldb.log('benchmark results written to ' + OUTPUT)
+
+    @classmethod
+    def record(cls, name, seconds, items, unit='rows'):
+        cls.results[name] = {
+            'seconds' : seconds,
+            'items' : items,
+            'unit' : unit,
+            'itemsPerSecond' : items / seconds if seconds > 0 else None
+        }
+        mldb.log('%s: %.3fs for %d %s (%.0f %s/s)'
+                 % (name, seconds, items, unit,
+                    items / seconds if seconds > 0 else 0, unit))
+
+    def best_of(self, fn, repeats=REPEATS):
+        """Time fn, returning the fastest of a few runs and its result."""
+        best = None
+        for _ in range(repeats):
+            start = time.time()
+            result = fn()
+            elapsed = time.time() - start
+            if best is None or elapsed < best:
+                best = elapsed
+        return best, result
+
+    def test_csv_import(self):
+        self.assertEqual(mldb.query('SELECT count(*) FROM bench_csv')[1][1],
+                         NUM_ROWS)
+
+    def test_tabular_freeze(self):
+        def run():
+            mldb.put('/v1/procedures/freeze', {
+                'type' : 'transform',
+                'params' : {
+                    'inputData' : 'SELECT * EXCLUDING (text) FROM bench_csv',
+                    'outputDataset' : {'id' : 'bench_frozen',
+                                       'type' : 'tabular'},
+                    'runOnCreation' : True
+                }
+            })
+        seconds, _ = self.best_of(run, 1)
+        self.record('tabular_freeze', seconds, NUM_ROWS)
+
+    def test_queries(self):
+        queries = {
+            'query_scan' :
+                'SELECT count(*) FROM bench_csv WHERE x0 > 0.5 AND x1 < 0',
+            'query_group_by' :
+                'SELECT category, avg(x2), max(x3), count(*) '
+                'FROM bench_csv GROUP BY category',
+            'query_order_by' :
+                'SELECT id, x4 FROM bench_csv ORDER BY x4 DESC LIMIT 100',
+            'query_tokenize' :
+                'SELECT sum(tokenize(text, {splitChars: \' \'})) AS * '
+                'FROM bench_csv'
+        }
+        for name, query in sorted(queries.items()):
+            seconds, res = self.best_of(lambda: mldb.query(query))
+            self.assertGreater(len(res), 1)
+            self.record(name, seconds, NUM_ROWS)
+
+    def test_joins(self):
+        dataset = mldb.create_dataset({'type' : 'tabular',
+                                       'id' : 'bench_categories'})
+        rng = random.Random(SEED + 1)
+        for i in range(NUM_CATEGORIES):
+            dataset.record_row('c%d' % i,
+                               [['category', 'c%d' % i, 0],
+                                ['weight', rng.random(), 0]])
+        dataset.commit()
+
+        def run():
+            return mldb.query(
+                'SELECT count(*), sum(c.weight * b.x0) '
+                'FROM bench_csv AS b JOIN bench_categories AS c '
+                'ON b.category = c.category')
+        seconds, res = self.best_of(run)
+        self.assertEqual(res[1][1], NUM_ROWS)
+        self.record('join', seconds, NUM_ROWS)
+
+    def test_classifier(self):
+        features = ', '.join('x%d' % i for i in range(NUM_FEATURES))
+
+        def train():
+            mldb.put('/v1/procedures/bench_train', {
+                'type' : 'classifier.train',
+                'params' : {
+                    'trainingData' :
+                        'SELECT {%s} AS features, label FROM bench_csv '
+                        'WHERE rowHash() %% 2 = 0' % features,
+                    'algorithm' : 'bbdt',
+                    'modelFileUrl' : 'file://tmp/macro_benchmark.cls',
+                    'functionName' : 'bench_classifier',
+                    'runOnCreation' : True
+                }
+            })
+        seconds, _ = self.best_of(train, 1)
+        self.record('classifier_train', seconds, NUM_ROWS // 2)
+
+        def score():
+            return mldb.query(
+                'SELECT count(*), avg(bench_classifier({features: {%s}})'
+                '[score]) FROM bench_csv WHERE rowHash() %% 2 = 1'
+                % features)
+        seconds, res = self.best_of(score)
+        self.record('classifier_score', seconds, res[1][1])
+
+    def test_embedding_neighbours(self):
+        num_points = min(NUM_ROWS, 20000)
+        features = ', '.join('x%d' % i for i in range(NUM_FEATURES))
+        mldb.put('/v1/procedures/bench_embed', {
+            'type' : 'transform',
+            'params' : {
+                'inputData' :
+                    'SELECT %s FROM bench_csv WHERE id < %d'
+                    % (features, num_points),
+                'outputDataset' : {'id' : 'bench_embedding',
+                                   'type' : 'embedding'},
+                'runOnCreation' : True
+            }
+        })
+        mldb.put('/v1/functions/bench_neighbours', {
+            'type' : 'embedding.neighbors',
+            'params' : {'dataset' : 'bench_embedding',
+                        'defaultNumNeighbors' : 10}
+        })
+
+        rng = random.Random(SEED + 2)
+        coords = [{'x%d' % i : rng.gauss(0, 1)
+                   for i in range(NUM_FEATURES)}
+                  for _ in range(200)]
+
+        def run():
+            for c in coords:
+                mldb.get('/v1/functions/bench_neighbours/application',
+                         input={'coords' : c})
+        seconds, _ = self.best_of(run)
+        self.record('embedding_neighbours', seconds, len(coords), 'calls')
+
+    def test_rest_function_latency(self):
+        mldb.put('/v1/functions/bench_expr', {
+            'type' : 'sql.expression',
+            'params' : {'expression' : 'x * 2 + y AS z, upper(s) AS t'}
+        })
+
+        num_calls = 1000
+        latencies = []
+        for i in range(num_calls):
+            start = time.time()
+            mldb.get('/v1/functions/bench_expr/application',
+                     input={'x' : i, 'y' : 1, 's' : 'abc'})
+            latencies.append(time.time() - start)
+        latencies.sort()
+
+        self.record('rest_function_call', sum(latencies), num_calls,
+                    'calls')
+        self.results['rest_function_call'].update({
+            'p50Seconds' : latencies[num_calls // 2],
+            'p99Seconds' : latencies[num_calls * 99 // 100]
+        })
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,122 @@
+#
+# mapped_embedding_dataset_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that the embedding.mapped dataset reads word2vec binary and text
+# vector files, and gives the same vectors as import.word2vec.
+#
+import random
+import struct
+import tempfile
+from mldb import mldb, MldbUnitTest, ResponseException
+
+NUM_WORDS = 2000
+NUM_DIMS = 7
+
+class MappedEmbeddingDatasetTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        cls.vectors = {}
+        for i in range(NUM_WORDS):
+            word = 'w%d' % i if i != 5 else 'café'
+            cls.vectors[word] = [
+                struct.unpack('f', struct.pack('f', random.uniform(-1, 1)))[0]
+                for _ in range(NUM_DIMS)]
+
+        cls.binary = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp',
+                                                 suffix='.bin')
+        cls.binary.write(('%d %d\n' % (NUM_WORDS, NUM_DIMS)).encode())
+        for word, vec in cls.vectors.items():
+            cls.binary.write(word.encode('utf-8') + b' ')
+            cls.binary.write(struct.pack('%df' % NUM_DIMS, *vec))
+            cls.binary.write(b'\n')
+        cls.binary.flush()
+
+        # GloVe style, without a header line
+        cls.text = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp',
+                                               suffix='.txt', mode='wt',
+                                               encoding='utf-8')
+        for word, vec in cls.vectors.items():
+            cls.text.write(word + ' ' + ' '.join(repr(v) for v in vec) + '\n')
+        cls.text.flush()
+
+        mldb.put('/v1/datasets/binary', {
+            'type' : 'embedding.mapped',
+            'params' : {
+                'dataFileUrl' : 'file://' + cls.binary.name
+            }
+        })
+
+        mldb.put('/v1/datasets/text', {
+            'type' : 'embedding.mapped',
+            'params' : {
+                'dataFileUrl' : 'file://' + cls.text.name,
+                'format' : 'text'
+            }
+        })
+
+    def check_dataset(self, dataset):
+        rows = mldb.query('select * from %s' % dataset)
+        self.assertEqual(len(rows) - 1, NUM_WORDS)
+        self.assertEqual(rows[0][1:], [str(i) for i in range(NUM_DIMS)])
+        for row in rows[1:]:
+            for got, expected in zip(row[1:], self.vectors[row[0]]):
+                self.assertAlmostEqual(got, expected, places=6)
+
+        res = mldb.query("select * from %s where rowName() = 'café'"
+                         % dataset)
+        self.assertEqual(len(res), 2)
+
+    def test_binary(self):
+        self.check_dataset('binary')
+        status = mldb.get('/v1/datasets/binary').json()['status']
+        self.assertEqual(status['rowCount'], NUM_WORDS)
+        self.assertTrue(status['mapped'])
+
+    def test_text(self):
+        self.check_dataset('text')
+
+    def test_same_as_import(self):
+        mldb.put('/v1/procedures/import', {
+            'type' : 'import.word2vec',
+            'params' : {
+                'dataFileUrl' : 'file://' + self.binary.name,
+                'outputDataset' : 'imported',
+                'runOnCreation' : True
+            }
+        })
+        self.assertTableResultEquals(
+            mldb.query("select * from imported where rowName() = 'w17'"),
+            mldb.query("select * from binary where rowName() = 'w17'"))
+
+    def test_pooling(self):
+        mldb.put('/v1/functions/pool', {
+            'type' : 'pooling',
+            'params' : {
+                'embeddingDataset' : 'binary',
+                'aggregators' : ['sum']
+            }
+        })
+        res = mldb.query("select pool({words: {w1: 1, w2: 1}}) as *")
+        expected = [a + b for a, b in zip(self.vectors['w1'],
+                                          self.vectors['w2'])]
+        for got, exp in zip(res[1][1:], expected):
+            self.assertAlmostEqual(got, exp, places=5)
+
+    def test_truncated_file(self):
+        truncated = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp',
+                                                suffix='.bin')
+        truncated.write(b'10 3\nword ')
+        truncated.flush()
+        with self.assertRaises(ResponseException):
+            mldb.put('/v1/datasets/truncated', {
+                'type' : 'embedding.mapped',
+                'params' : {
+                    'dataFileUrl' : 'file://' + truncated.name
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,283 @@
+/* procedure_run_scheduler_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test for the scheduler that decides when procedure runs may start.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/engine/procedure_run_scheduler.h"
+#include "mldb/core/procedure.h"
+#include "mldb/rest/cancellation_exception.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+static ProcedureRunConfig
+runConfig(double cpus = 0, int queuePriority = 0, uint64_t memoryBytes = 0)
+{
+    ProcedureRunConfig result;
+    result.resources.cpus = cpus;
+    result.resources.memoryBytes = memoryBytes;
+    result.queuePriority = queuePriority;
+    return result;
+}
+
+/** Wait until the scheduler has the given number of runs queued. */
+static void waitForQueued(const ProcedureRunScheduler & scheduler, int n)
+{
+    while (scheduler.getStatus()["numQueued"].asInt() != n)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+/** A run that executes in its own thread until it's told to finish.  As in
+    the server, the ticket is released by the thread that was admitted.
+*/
+struct TestRun {
+    TestRun(ProcedureRunScheduler & scheduler, const std::string & name,
+            const ProcedureRunConfig & config = runConfig())
+        : started(false), finished(false),
+          thread([&scheduler, name, config, this] ()
+                 {
+                     auto ticket = scheduler.admit("p", name, config);
+                     started = true;
+                     while (!finished)
+                         std::this_thread::sleep_for
+                             (std::chrono::milliseconds(1));
+                 })
+    {
+    }
+
+    ~TestRun()
+    {
+        finish();
+    }
+
+    void waitStarted()
+    {
+        while (!started)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    void finish()
+    {
+        finished = true;
+        if (thread.joinable())
+            thread.join();
+    }
+
+    std::atomic<bool> started, finished;
+    std::thread thread;
+};
+
+BOOST_AUTO_TEST_CASE( test_unlimited_by_default )
+{
+    ProcedureRunScheduler scheduler;
+    std::vector<std::unique_ptr<TestRun> > runs;
+    for (unsigned i = 0;  i < 20;  ++i)
+        runs.emplace_back(new TestRun(scheduler, "r" + to_string(i)));
+    for (auto & r: runs)
+        r->waitStarted();
+    BOOST_CHECK_EQUAL(scheduler.getStatus()["numExecuting"].asInt(), 20);
+    runs.clear();
+    auto status = scheduler.getStatus();
+    BOOST_CHECK_EQUAL(status["numExecuting"].asInt(), 0);
+    BOOST_CHECK_EQUAL(status["numStartedAfterWaiting"].asInt(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_max_concurrent_runs )
+{
+    ProcedureRunScheduler scheduler;
+    scheduler.parseLimits("2");
+
+    std::atomic<int> executing(0), maxExecuting(0);
+
+    auto run = [&] (int i)
+        {
+            auto ticket = scheduler.admit("p", "r" + to_string(i), runConfig());
+            int now = ++executing;
+            int prev = maxExecuting;
+            while (now > prev && !maxExecuting.compare_exchange_weak(prev, now))
+                ;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            --executing;
+        };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0;  i < 8;  ++i)
+        threads.emplace_back(run, i);
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(maxExecuting, 2);
+    auto status = scheduler.getStatus();
+    BOOST_CHECK_EQUAL(status["numStarted"].asInt(), 8);
+    BOOST_CHECK_GE(status["numStartedAfterWaiting"].asInt(), 6);
+}
+
+BOOST_AUTO_TEST_CASE( test_cpu_reservation )
+{
+    ProcedureRunScheduler scheduler;
+    scheduler.parseLimits("-1:4");
+
+    TestRun big1(scheduler, "big1", runConfig(3));
+    big1.waitStarted();
+
+    // Fits alongside the first one
+    TestRun small(scheduler, "small", runConfig(1));
+    small.waitStarted();
+
+    // Doesn't fit until both have finished
+    TestRun big2(scheduler, "big2", runConfig(3));
+    waitForQueued(scheduler, 1);
+    BOOST_CHECK(scheduler.isQueued("p", "big2"));
+
+    small.finish();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    BOOST_CHECK(scheduler.isQueued("p", "big2"));
+
+    big1.finish();
+    big2.waitStarted();
+    BOOST_CHECK_EQUAL(scheduler.getStatus()["cpusReserved"].asDouble(), 3);
+    big2.finish();
+
+    // A run that reserves more than there is starts once it's alone
+    TestRun huge(scheduler, "huge", runConfig(16));
+    huge.waitStarted();
+}
+
+BOOST_AUTO_TEST_CASE( test_memory_reservation )
+{
+    ProcedureRunScheduler scheduler;
+    scheduler.parseLimits("-1:-1:1G");
+    BOOST_CHECK_EQUAL(scheduler.getLimits().memoryBytes, 1ULL << 30);
+
+    TestRun r1(scheduler, "r1", runConfig(0, 0, 600 << 20));
+    r1.waitStarted();
+    TestRun r2(scheduler, "r2", runConfig(0, 0, 600 << 20));
+    waitForQueued(scheduler, 1);
+    r1.finish();
+    r2.waitStarted();
+}
+
+BOOST_AUTO_TEST_CASE( test_priority_order )
+{
+    ProcedureRunScheduler scheduler;
+    scheduler.parseLimits("1");
+
+    TestRun blocker(scheduler, "blocker");
+    blocker.waitStarted();
+
+    std::mutex mutex;
+    std::vector<std::string> order;
+
+    auto run = [&] (std::string name, int priority)
+        {
+            auto ticket = scheduler.admit("p", name, runConfig(0, priority));
+            std::unique_lock<std::mutex> guard(mutex);
+            order.push_back(name);
+        };
+
+    std::vector<std::thread> threads;
+    threads.emplace_back(run, "low1", 0);
+    waitForQueued(scheduler, 1);
+    threads.emplace_back(run, "low2", 0);
+    waitForQueued(scheduler, 2);
+    threads.emplace_back(run, "high", 5);
+    waitForQueued(scheduler, 3);
+
+    auto status = scheduler.getStatus();
+    BOOST_CHECK_EQUAL(status["queued"][0]["run"].asString(), "high");
+    BOOST_CHECK_EQUAL(status["queued"][1]["run"].asString(), "low1");
+    BOOST_CHECK_EQUAL(status["queued"][2]["run"].asString(), "low2");
+
+    blocker.finish();
+    for (auto & t: threads)
+        t.join();
+
+    std::vector<std::string> expected = { "high", "low1", "low2" };
+    BOOST_CHECK_EQUAL_COLLECTIONS(order.begin(), order.end(),
+                                  expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE( test_cancel_while_queued )
+{
+    ProcedureRunScheduler scheduler;
+    scheduler.parseLimits("1");
+
+    TestRun blocker(scheduler, "blocker");
+    blocker.waitStarted();
+
+    std::atomic<bool> cancelled(false);
+    std::atomic<int> numCalls(0);
+    auto onWaiting = [&] (const Json::Value & progress)
+        {
+            BOOST_CHECK(progress["queued"].asBool());
+            ++numCalls;
+            return !cancelled;
+        };
+
+    bool threw = false;
+    std::thread t([&] ()
+                  {
+                      try {
+                          scheduler.admit("p", "r", runConfig(), onWaiting);
+                      } catch (const CancellationException & exc) {
+                          threw = true;
+                      }
+                  });
+    waitForQueued(scheduler, 1);
+    cancelled = true;
+    t.join();
+
+    BOOST_CHECK(threw);
+    BOOST_CHECK_GE(numCalls, 1);
+    BOOST_CHECK(!scheduler.isQueued("p", "r"));
+    BOOST_CHECK_EQUAL(scheduler.getStatus()["numExecuting"].asInt(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_nested_runs_dont_wait )
+{
+    ProcedureRunScheduler scheduler;
+    scheduler.parseLimits("1");
+
+    {
+        auto outer = scheduler.admit("p", "outer", runConfig());
+
+        // From the same thread, as a procedure that runs another one would
+        auto inner = scheduler.admit("q", "inner", runConfig());
+        BOOST_CHECK(inner);
+        BOOST_CHECK_EQUAL(scheduler.getStatus()["numExecuting"].asInt(), 1);
+    }
+
+    // Once the outer run is over, the thread waits like any other
+    TestRun other(scheduler, "other");
+    other.waitStarted();
+
+    bool threw = false;
+    try {
+        scheduler.admit("p", "after", runConfig(),
+                        [] (const Json::Value &) { return false; });
+    } catch (const CancellationException & exc) {
+        threw = true;
+    }
+    BOOST_CHECK(threw);
+}
+
+BOOST_AUTO_TEST_CASE( test_bad_limits )
+{
+    ProcedureRunScheduler scheduler;
+    BOOST_CHECK_THROW(scheduler.parseLimits("0"), std::exception);
+    BOOST_CHECK_THROW(scheduler.parseLimits("2:0"), std::exception);
+    BOOST_CHECK_THROW(scheduler.parseLimits("2:4:lots"), std::exception);
+    BOOST_CHECK_THROW(scheduler.parseLimits("two"), std::exception);
+}
@@ -0,0 +1,65 @@
+#
+# python_array_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Exchange of arrays between Python and MLDB through the buffer protocol.
+#
+import array
+from mldb import mldb, MldbUnitTest
+
+
+class PythonArrayTest(MldbUnitTest):  # noqa
+
+    def test_record_embedding_and_query_array(self):
+        ds = mldb.create_dataset({'id' : 'arr', 'type' : 'sparse.mutable'})
+        values = array.array('d', [1.5, 2.5, 3.5, -1, -2, -3])
+        ds.record_embedding(['x', 'y', 'z'], ['r0', 'r1'],
+                            memoryview(values).cast('B').cast('d', [2, 3]),
+                            0)
+        ds.commit()
+
+        self.assertTableResultEquals(
+            mldb.query('SELECT * FROM arr ORDER BY rowName()'),
+            [['_rowName', 'x', 'y', 'z'],
+             ['r0', 1.5, 2.5, 3.5],
+             ['r1', -1, -2, -3]])
+
+        rows, columns, result = mldb.query_array(
+            'SELECT x, y, z FROM arr ORDER BY rowName()')
+        self.assertEqual(rows, ['r0', 'r1'])
+        self.assertEqual(columns, ['x', 'y', 'z'])
+
+        view = memoryview(result)
+        self.assertTrue(view.readonly)
+        self.assertEqual(view.format, 'd')
+        self.assertEqual(view.shape, (2, 3))
+        self.assertEqual(view.tolist(), [[1.5, 2.5, 3.5], [-1, -2, -3]])
+
+        # The view keeps the array alive
+        del result
+        self.assertEqual(view[1, 2], -3)
+
+    def test_integer_and_strided_arrays(self):
+        ds = mldb.create_dataset({'id' : 'ints', 'type' : 'sparse.mutable'})
+        values = array.array('i', [1, 2, 3, 4, 5, 6, 7, 8])
+        view = memoryview(values).cast('B').cast('i', [4, 2])[::2]
+        ds.record_embedding(['a', 'b'], ['r0', 'r1'], view, 0)
+        ds.commit()
+
+        self.assertTableResultEquals(
+            mldb.query('SELECT * FROM ints ORDER BY rowName()'),
+            [['_rowName', 'a', 'b'],
+             ['r0', 1, 2],
+             ['r1', 5, 6]])
+
+    def test_wrong_shape(self):
+        ds = mldb.create_dataset({'id' : 'bad', 'type' : 'sparse.mutable'})
+        values = array.array('d', [1, 2, 3, 4])
+        with self.assertRaises(Exception):
+            ds.record_embedding(['x', 'y', 'z'], ['r0'], values, 0)
+        with self.assertRaises(Exception):
+            ds.record_embedding(['x'], ['r0'], 'not an array', 0)
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
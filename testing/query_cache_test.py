@@ -0,0 +1,137 @@
+#
+# query_cache_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that the statement cache of /v1/query, its result cache and the
+# bound queries of sql.query functions are reused, and are bound again or
+# run again when the datasets that they read from change.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class QueryCacheTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.make_dataset(1)
+
+    @classmethod
+    def make_dataset(cls, value):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        ds.record_row('row1', [['x', value, 0]])
+        ds.commit()
+
+    def get_stats(self):
+        return mldb.get('/v1/queryCache').json()['statements']
+
+    def test_statement_cache_hits(self):
+        query = "SELECT x + 1 AS y FROM ds WHERE x IS NOT NULL"
+        mldb.query(query)
+        before = self.get_stats()
+
+        for i in range(5):
+            res = mldb.query(query)
+            self.assertEqual(res, [['_rowName', 'y'], ['row1', 2]])
+
+        # Surrounding whitespace doesn't make it a different statement
+        mldb.query("  " + query + "\n")
+
+        after = self.get_stats()
+        self.assertEqual(after['hits'] - before['hits'], 6)
+        self.assertEqual(after['misses'], before['misses'])
+        self.assertGreaterEqual(after['capacity'], after['size'])
+
+    def test_parse_errors_not_cached(self):
+        before = self.get_stats()
+        for i in range(2):
+            with self.assertRaises(ResponseException):
+                mldb.query("SELECT FROM WHERE")
+        after = self.get_stats()
+        self.assertEqual(after['misses'] - before['misses'], 2)
+
+    def test_function_rebinds_on_dataset_change(self):
+        mldb.put('/v1/functions/getx', {
+            'type' : 'sql.query',
+            'params' : {
+                'query' : 'SELECT x FROM ds WHERE rowName() = $row'
+            }
+        })
+
+        def get_x():
+            return mldb.get('/v1/functions/getx/application',
+                            input={'row' : 'row1'}).json()['output']['x']
+
+        self.assertEqual(get_x(), 1)
+        self.assertEqual(get_x(), 1)
+
+        status = mldb.get('/v1/functions/getx').json()['status']
+        self.assertGreater(status['boundQueryCache']['hits'], 0)
+
+        # Replacing the dataset means that the function must bind again
+        mldb.delete('/v1/datasets/ds')
+        self.make_dataset(2)
+        try:
+            self.assertEqual(get_x(), 2)
+        finally:
+            mldb.delete('/v1/datasets/ds')
+            self.make_dataset(1)
+
+    def test_result_cache(self):
+        def results():
+            return mldb.get('/v1/queryCache').json()['results']
+
+        self.assertEqual(results()['capacityBytes'], 0)
+        mldb.put('/v1/queryCache/results', {'capacityBytes' : 1000000})
+        try:
+            ds = mldb.create_dataset({'id' : 'results',
+                                      'type' : 'sparse.mutable'})
+            ds.record_row('a', [['x', 1, 0]])
+            ds.commit()
+
+            query = "SELECT sum(x) AS total FROM results"
+            before = results()
+            self.assertEqual(mldb.query(query)[1][1], 1)
+            self.assertEqual(mldb.query(query)[1][1], 1)
+            after = results()
+            self.assertEqual(after['misses'] - before['misses'], 1)
+            self.assertEqual(after['hits'] - before['hits'], 1)
+            self.assertGreater(after['bytes'], 0)
+            self.assertGreater(after['hitRate'], 0)
+
+            # Committing new rows makes the result stale
+            ds.record_row('b', [['x', 2, 0]])
+            ds.commit()
+            self.assertEqual(mldb.query(query)[1][1], 3)
+            self.assertEqual(
+                results()['invalidations'] - after['invalidations'], 1)
+
+            # So does replacing the dataset
+            mldb.delete('/v1/datasets/results')
+            ds = mldb.create_dataset({'id' : 'results',
+                                      'type' : 'sparse.mutable'})
+            ds.record_row('c', [['x', 10, 0]])
+            ds.commit()
+            self.assertEqual(mldb.query(query)[1][1], 10)
+
+            # Results that depend on the time aren't kept
+            before = results()
+            mldb.query("SELECT now() AS t")
+            mldb.query("SELECT now() AS t")
+            after = results()
+            self.assertEqual(after['uncacheable'] - before['uncacheable'], 2)
+            self.assertEqual(after['hits'], before['hits'])
+
+            # A result older than the maximum age is run again
+            mldb.put('/v1/queryCache/results', {'capacityBytes' : 1000000,
+                                                'maxAgeSeconds' : 0})
+            before = results()
+            mldb.query(query)
+            self.assertEqual(results()['hits'], before['hits'])
+        finally:
+            mldb.put('/v1/queryCache/results', {'capacityBytes' : 0})
+            mldb.delete('/v1/datasets/results')
+
+        self.assertEqual(results()['entries'], 0)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,89 @@
+#
+# query_explain_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check the plans returned by /v1/query with explain=true.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class QueryExplainTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(100):
+            ds.record_row('row%d' % i, [['x', i, 0], ['y', i % 3, 0]])
+        ds.commit()
+
+    def explain(self, query):
+        return mldb.get('/v1/query', q=query, explain='true').json()
+
+    def find_all(self, node, type):
+        result = []
+        if node['type'] == type:
+            result.append(node)
+        for child in node.get('children', []):
+            result.extend(self.find_all(child, type))
+        return result
+
+    def check_times(self, node):
+        self.assertGreaterEqual(node['wallTime'], 0)
+        self.assertGreaterEqual(node['selfTime'], 0)
+        self.assertLessEqual(node['selfTime'], node['wallTime'])
+        for child in node.get('children', []):
+            self.check_times(child)
+
+    def test_select(self):
+        plan = self.explain("SELECT x FROM ds WHERE x >= 90 ORDER BY x")
+        self.assertEqual(plan['type'], 'Query')
+        self.assertEqual(plan['rowsOut'], 10)
+        self.check_times(plan)
+
+        [select] = self.find_all(plan, 'SelectQuery')
+        self.assertEqual(select['details']['executor'], 'OrderedExecutor')
+        self.assertEqual(select['rowsOut'], 10)
+        self.assertGreater(select['bytes'], 0)
+
+        [where] = self.find_all(plan, 'GenerateRowsWhere')
+        self.assertIn('algorithm', where['details'])
+        self.assertIn('complexity', where['details'])
+
+    def test_group_by(self):
+        plan = self.explain("SELECT y, count(*) FROM ds GROUP BY y")
+        self.assertEqual(plan['rowsOut'], 3)
+        self.check_times(plan)
+
+        [group] = self.find_all(plan, 'GroupByQuery')
+        self.assertEqual(group['rowsOut'], 3)
+        self.assertEqual(group['details']['spilled'], False)
+
+        # The rows are selected before being grouped
+        [select] = self.find_all(group, 'SelectQuery')
+        self.assertEqual(select['rowsOut'], 100)
+        self.assertEqual(group['rowsIn'], 100)
+
+    def test_pipeline(self):
+        plan = self.explain(
+            "SELECT value FROM row_dataset({a: 1, b: 2, c: 3}) WHERE value > 1")
+        self.assertEqual(plan['rowsOut'], 2)
+        self.check_times(plan)
+
+        # The row generator may apply the WHERE clause itself, so it
+        # outputs either all of the rows or only those that match
+        [generate] = self.find_all(plan, 'GenerateRowsElement')
+        self.assertIn(generate['rowsOut'], [2, 3])
+        self.assertIn('rowGenerator', generate['details'])
+        [where] = self.find_all(plan, 'FilterWhereElement')
+        self.assertEqual(where['rowsIn'], generate['rowsOut'])
+        self.assertEqual(where['rowsOut'], 2)
+        self.assertGreater(len(self.find_all(plan, 'SelectElement')), 0)
+
+    def test_explain_doesnt_change_query(self):
+        query = "SELECT x FROM ds WHERE x < 5 ORDER BY x"
+        self.assertEqual(len(mldb.query(query)), 6)
+        self.assertEqual(self.explain(query)['rowsOut'], 5)
+        self.assertEqual(len(mldb.query(query)), 6)
+
+if __name__ == '__main__':
+    mldb.run_tests()
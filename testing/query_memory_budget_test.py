@@ -0,0 +1,64 @@
+#
+# query_memory_budget_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that queries that go over their memory budget, and so spill their
+# intermediate results to disk, give the same results as those that don't.
+#
+
+import os
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class QueryMemoryBudgetTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(5000):
+            cols = [['x', i % 97, 0], ['y', 'v%d' % (i % 13), 0],
+                    ['z', i * 0.5, i]]
+            if i % 7 == 0:
+                cols.append(['w', 'only some rows', 0])
+            ds.record_row('row%d' % i, cols)
+        ds.commit()
+
+    def tearDown(self):
+        os.environ.pop('MLDB_QUERY_MEMORY_BUDGET', None)
+
+    def check_same_with_budget(self, query):
+        expected = mldb.query(query)
+        # A budget this small makes everything be spilled
+        os.environ['MLDB_QUERY_MEMORY_BUDGET'] = '1'
+        try:
+            self.assertTableResultEquals(mldb.query(query), expected)
+        finally:
+            os.environ.pop('MLDB_QUERY_MEMORY_BUDGET', None)
+
+    def test_order_by(self):
+        self.check_same_with_budget(
+            "SELECT * FROM ds ORDER BY x, rowName()")
+        self.check_same_with_budget(
+            "SELECT x, z, w FROM ds ORDER BY z DESC")
+        self.check_same_with_budget(
+            "SELECT x, y FROM ds ORDER BY y, x, rowName() OFFSET 100")
+
+    def test_order_by_distinct_on(self):
+        self.check_same_with_budget(
+            "SELECT DISTINCT ON (x) x, y FROM ds ORDER BY x, rowName()")
+
+    def test_group_by(self):
+        self.check_same_with_budget(
+            "SELECT x, count(*), sum(z), min(y), max(w) FROM ds GROUP BY x")
+        self.check_same_with_budget(
+            """SELECT x, y, count(*) AS c FROM ds GROUP BY x, y
+               ORDER BY c DESC, x, y LIMIT 50""")
+
+    def test_invalid_budget(self):
+        os.environ['MLDB_QUERY_MEMORY_BUDGET'] = 'lots'
+        with self.assertRaisesRegex(ResponseException,
+                                    'MLDB_QUERY_MEMORY_BUDGET'):
+            mldb.query("SELECT * FROM ds ORDER BY x")
+
+if __name__ == '__main__':
+    mldb.run_tests()
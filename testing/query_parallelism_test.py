@@ -0,0 +1,59 @@
+#
+# query_parallelism_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check the parallelism and priority parameters of queries and procedure
+# runs.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class QueryParallelismTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(1000):
+            ds.record_row('row%d' % i, [['x', i, 0], ['y', i % 7, 0]])
+        ds.commit()
+
+    def query(self, **kwargs):
+        return mldb.get('/v1/query',
+                        q='SELECT y, count(*) AS n FROM ds GROUP BY y '
+                          'ORDER BY y',
+                        format='table', **kwargs).json()
+
+    def test_same_result(self):
+        expected = self.query()
+        self.assertEqual(self.query(maxParallelism=1), expected)
+        self.assertEqual(self.query(maxParallelism=2, priority='batch'),
+                         expected)
+        self.assertEqual(self.query(priority='interactive'), expected)
+
+    def test_bad_params(self):
+        with self.assertRaises(ResponseException):
+            self.query(maxParallelism=0)
+        with self.assertRaises(ResponseException):
+            self.query(priority='urgent')
+
+    def test_procedure_run(self):
+        mldb.put('/v1/procedures/tf', {
+            'type' : 'transform',
+            'params' : {
+                'inputData' : 'SELECT x * 2 AS x2 FROM ds',
+                'outputDataset' : 'ds_out',
+                'runOnCreation' : False
+            }
+        })
+
+        mldb.post('/v1/procedures/tf/runs',
+                  {'maxParallelism' : 2, 'priority' : 'batch'})
+        self.assertEqual(mldb.query('SELECT count(*) FROM ds_out')[1][1], 1000)
+
+        with self.assertRaises(ResponseException):
+            mldb.post('/v1/procedures/tf/runs', {'maxParallelism' : 0})
+        with self.assertRaises(ResponseException):
+            mldb.post('/v1/procedures/tf/runs', {'priority' : 'urgent'})
+
+if __name__ == '__main__':
+    mldb.run_tests()
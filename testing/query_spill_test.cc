@@ -0,0 +1,199 @@
+/** query_spill_test.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Tests for the spilling of intermediate query results.
+*/
+
+#include "mldb/engine/query_spill.h"
+#include "mldb/types/value_description.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/tuple_description.h"
+#include "mldb/arch/exception_handler.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+
+using namespace std;
+
+using namespace MLDB;
+
+static void checkRoundTrip(const ExpressionValue & val)
+{
+    SpillWriter writer;
+    writer.write(val);
+    SpillReader reader(writer.bytes.data(),
+                       writer.bytes.data() + writer.bytes.size());
+    ExpressionValue val2 = reader.readExpressionValue();
+    BOOST_CHECK(reader.done());
+    BOOST_CHECK_EQUAL(jsonEncodeStr(val2), jsonEncodeStr(val));
+    BOOST_CHECK_EQUAL(val2.getEffectiveTimestamp(),
+                      val.getEffectiveTimestamp());
+}
+
+BOOST_AUTO_TEST_CASE( test_round_trip_atoms )
+{
+    Date ts = Date::fromSecondsSinceEpoch(1234.5);
+
+    checkRoundTrip(ExpressionValue());
+    checkRoundTrip(ExpressionValue::null(ts));
+    checkRoundTrip(ExpressionValue(1, ts));
+    checkRoundTrip(ExpressionValue(-123456789012LL, ts));
+    checkRoundTrip(ExpressionValue(1ULL << 63, ts));
+    checkRoundTrip(ExpressionValue(0.5, ts));
+    checkRoundTrip(ExpressionValue("hello", Date::notADate()));
+    checkRoundTrip(ExpressionValue(Utf8String("h\xc3\xa9llo"), ts));
+    checkRoundTrip(ExpressionValue(std::string(1000, 'x'), ts));
+    checkRoundTrip(ExpressionValue(CellValue(Path({"a", "b.c", ""})), ts));
+    checkRoundTrip(ExpressionValue(Date::fromSecondsSinceEpoch(10), ts));
+}
+
+BOOST_AUTO_TEST_CASE( test_round_trip_structured )
+{
+    Date ts1 = Date::fromSecondsSinceEpoch(1);
+    Date ts2 = Date::fromSecondsSinceEpoch(2);
+
+    StructValue inner;
+    inner.emplace_back(PathElement("x"), ExpressionValue(1, ts1));
+    inner.emplace_back(PathElement(""), ExpressionValue("y", ts2));
+
+    StructValue outer;
+    outer.emplace_back(PathElement("a"), ExpressionValue(std::move(inner)));
+    outer.emplace_back(PathElement("b"), ExpressionValue(2.5, ts2));
+    outer.emplace_back(PathElement("0"),
+                       ExpressionValue(std::vector<double>{ 1, 2, 3, 4 },
+                                       ts1, { 2, 2 }));
+
+    ExpressionValue row(std::move(outer));
+    checkRoundTrip(row);
+
+    // The timestamps of the nested values are kept
+    SpillWriter writer;
+    writer.write(row);
+    SpillReader reader(writer.bytes.data(),
+                       writer.bytes.data() + writer.bytes.size());
+    ExpressionValue row2 = reader.readExpressionValue();
+    BOOST_CHECK_EQUAL(row2.getNestedColumn(Path({"a", "x"})).getEffectiveTimestamp(), ts1);
+    BOOST_CHECK_EQUAL(row2.getNestedColumn(Path({"a", ""})).getEffectiveTimestamp(), ts2);
+    BOOST_CHECK_EQUAL(row2.getColumn(PathElement("0")).getEmbeddingShape(),
+                      DimsVector({ 2, 2 }));
+}
+
+BOOST_AUTO_TEST_CASE( test_round_trip_named_row )
+{
+    NamedRowValue row;
+    row.rowName = Path({"row", "1"});
+    row.rowHash = RowHash(row.rowName);
+    row.columns.emplace_back(PathElement("x"), ExpressionValue(3, Date()));
+
+    std::vector<ExpressionValue> keys = { ExpressionValue(1, Date()),
+                                          ExpressionValue("a", Date()) };
+
+    SpillWriter writer;
+    writer.write(keys);
+    writer.write(row);
+    writer.write(Path());
+
+    SpillReader reader(writer.bytes.data(),
+                       writer.bytes.data() + writer.bytes.size());
+    auto keys2 = reader.readExpressionValues();
+    auto row2 = reader.readNamedRowValue();
+    auto path2 = reader.readPath();
+    BOOST_CHECK(reader.done());
+
+    BOOST_CHECK_EQUAL(jsonEncodeStr(keys2), jsonEncodeStr(keys));
+    BOOST_CHECK_EQUAL(row2.rowName, row.rowName);
+    BOOST_CHECK_EQUAL(row2.rowHash, row.rowHash);
+    BOOST_CHECK_EQUAL(jsonEncodeStr(row2.columns), jsonEncodeStr(row.columns));
+    BOOST_CHECK(path2.empty());
+
+    // Reading past the end throws
+    MLDB_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(reader.readUnsigned(), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_spill_file )
+{
+    SpillFile file;
+
+    std::vector<FrozenMemoryRegion> runs;
+    for (int i = 0;  i < 100;  ++i) {
+        SpillWriter writer;
+        for (int j = 0;  j < 1000;  ++j)
+            writer.write(ExpressionValue(i * 1000 + j, Date()));
+        runs.push_back(file.write(writer));
+    }
+
+    for (int i = 0;  i < 100;  ++i) {
+        SpillReader reader(runs[i]);
+        for (int j = 0;  j < 1000;  ++j) {
+            BOOST_CHECK_EQUAL(reader.readExpressionValue().getAtom(),
+                              i * 1000 + j);
+        }
+        BOOST_CHECK(reader.done());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_sorted_run_merger )
+{
+    // Pairs of (value, run) that compare only on the value, so that we can
+    // check that equal values come out in the order of their runs
+    typedef std::pair<int, int> Value;
+    auto less = [] (const Value & v1, const Value & v2)
+        {
+            return v1.first < v2.first;
+        };
+
+    std::vector<std::vector<Value> > runs = {
+        { { 1, 0 }, { 3, 0 }, { 3, 0 }, { 7, 0 } },
+        { },
+        { { 0, 2 }, { 3, 2 }, { 8, 2 } },
+        { { 3, 3 } }
+    };
+
+    typedef SortedRunMerger<Value, decltype(less)> Merger;
+    std::vector<Merger::Cursor> cursors;
+    for (auto & run: runs) {
+        size_t pos = 0;
+        cursors.emplace_back([&run, pos] (Value & val) mutable
+                             {
+                                 if (pos == run.size())
+                                     return false;
+                                 val = run[pos++];
+                                 return true;
+                             });
+    }
+
+    Merger merger(std::move(cursors), less);
+
+    std::vector<Value> result;
+    Value val;
+    while (merger.next(val))
+        result.push_back(val);
+
+    std::vector<Value> expected = {
+        { 0, 2 }, { 1, 0 }, { 3, 0 }, { 3, 0 }, { 3, 2 }, { 3, 3 },
+        { 7, 0 }, { 8, 2 }
+    };
+
+    BOOST_CHECK(result == expected);
+}
+
+BOOST_AUTO_TEST_CASE( test_budget )
+{
+    QueryMemoryBudget unlimited(0);
+    BOOST_CHECK(!unlimited.enabled());
+    BOOST_CHECK(!unlimited.reserve(1000000));
+    BOOST_CHECK(!unlimited.overBudget());
+
+    QueryMemoryBudget budget(1000);
+    BOOST_CHECK(budget.enabled());
+    BOOST_CHECK(!budget.reserve(600));
+    BOOST_CHECK(budget.reserve(600));
+    BOOST_CHECK(budget.overBudget());
+    budget.release(600);
+    BOOST_CHECK(!budget.overBudget());
+    BOOST_CHECK(!budget.hasSpilled());
+}
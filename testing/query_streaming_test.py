@@ -0,0 +1,80 @@
+#
+# query_streaming_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Tests of the jsonl and csv formats of /v1/query, which are streamed.
+#
+
+import json
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class QueryStreamingTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(2000):
+            cols = [['x', i, 0], ['y', 'row, "%d"' % i, 0]]
+            if i >= 1500:
+                cols.append(['z', i * 2, 0])
+            ds.record_row('r%04d' % i, cols)
+        ds.commit()
+
+    def query(self, q, **kwargs):
+        return mldb.get('/v1/query', q=q, **kwargs).text
+
+    def test_jsonl(self):
+        text = self.query('SELECT x, y, z FROM ds ORDER BY x', format='jsonl')
+        lines = text.splitlines()
+        self.assertEqual(len(lines), 2000)
+        self.assertEqual(json.loads(lines[0]),
+                         {'_rowName' : 'r0000', 'x' : 0, 'y' : 'row, "0"'})
+        self.assertEqual(json.loads(lines[1999]),
+                         {'_rowName' : 'r1999', 'x' : 1999,
+                          'y' : 'row, "1999"', 'z' : 3998})
+
+    def test_jsonl_same_as_aos(self):
+        q = 'SELECT * FROM ds ORDER BY x LIMIT 10'
+        lines = self.query(q, format='jsonl', rowHashes=True).splitlines()
+        aos = mldb.get('/v1/query', q=q, format='aos', rowHashes=True).json()
+        self.assertEqual([json.loads(l) for l in lines], aos)
+
+    def test_csv(self):
+        text = self.query('SELECT x, y FROM ds ORDER BY x LIMIT 3',
+                          format='csv')
+        self.assertEqual(text.split('\r\n'),
+                         ['_rowName,x,y',
+                          'r0000,0,"row, ""0"""',
+                          'r0001,1,"row, ""1"""',
+                          'r0002,2,"row, ""2"""',
+                          ''])
+
+        text = self.query('SELECT x FROM ds ORDER BY x LIMIT 2',
+                          format='csv', headers=False, rowNames=False)
+        self.assertEqual(text, '0\r\n1\r\n')
+
+    def test_csv_late_column(self):
+        # z first appears after the rows that the header is taken from;
+        # since output has already been sent, the error is the last line
+        text = self.query('SELECT x, z FROM ds ORDER BY x', format='csv')
+        lines = text.split('\r\n')
+        self.assertEqual(lines[0], '_rowName,x')
+        self.assertTrue(lines[-2].startswith('#error,'))
+        self.assertIn('jsonl', lines[-2])
+
+        # With z in the first rows, it's fine
+        text = self.query('SELECT x, z FROM ds ORDER BY x DESC', format='csv')
+        lines = text.split('\r\n')
+        self.assertEqual(lines[0], '_rowName,x,z')
+        self.assertEqual(lines[1], 'r1999,1999,3998')
+        self.assertEqual(lines[1000], 'r1000,1000,')
+        self.assertEqual(len(lines), 2002)
+
+    def test_error_before_output(self):
+        with self.assertRaises(ResponseException) as re:
+            self.query('SELECT x FROM no_such_dataset', format='jsonl')
+        self.assertEqual(re.exception.response.status_code, 400)
+
+if __name__ == '__main__':
+    mldb.run_tests()
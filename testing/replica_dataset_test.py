@@ -0,0 +1,79 @@
+#
+# replica_dataset_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Publish snapshots of a dataset with snapshot.publish and serve them with
+# a replica dataset, which switches to each new version as it's published.
+#
+import tempfile
+import time
+from mldb import mldb, MldbUnitTest, ResponseException
+
+
+class ReplicaDatasetTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.snapshot_dir = tempfile.mkdtemp(dir='build/x86_64/tmp')
+        cls.snapshot_url = 'file://' + cls.snapshot_dir + '/snapshots'
+
+    def make_source(self, dataset_id, values):
+        ds = mldb.create_dataset({'id' : dataset_id, 'type' : 'tabular'})
+        for i, value in enumerate(values):
+            ds.record_row('r%d' % i, [['x', value, 0]])
+        ds.commit()
+
+    def publish(self, dataset_id):
+        return mldb.post('/v1/procedures', {
+            'type' : 'snapshot.publish',
+            'params' : {
+                'dataset' : dataset_id,
+                'snapshotUrl' : self.snapshot_url,
+                'runOnCreation' : True
+            }
+        }).json()['status']['firstRun']['status']
+
+    def test_replica_switches_to_new_snapshot(self):
+        self.make_source('v1', [1, 2, 3])
+        self.assertEqual(self.publish('v1')['version'], 1)
+
+        mldb.put('/v1/datasets/rep', {
+            'type' : 'replica',
+            'params' : {
+                'snapshotUrl' : self.snapshot_url,
+                'pollInterval' : 0.1
+            }
+        })
+        self.assertTableResultEquals(
+            mldb.query('SELECT * FROM rep ORDER BY rowName()'),
+            mldb.query('SELECT * FROM v1 ORDER BY rowName()'))
+
+        self.make_source('v2', [10, 20])
+        self.assertEqual(self.publish('v2')['version'], 2)
+
+        deadline = time.time() + 30
+        while mldb.get('/v1/datasets/rep').json()['status']['version'] != 2:
+            self.assertLess(time.time(), deadline)
+            time.sleep(0.1)
+
+        self.assertTableResultEquals(
+            mldb.query('SELECT * FROM rep ORDER BY rowName()'),
+            mldb.query('SELECT * FROM v2 ORDER BY rowName()'))
+
+    def test_no_snapshot(self):
+        with self.assertRaises(ResponseException):
+            mldb.put('/v1/datasets/empty_rep', {
+                'type' : 'replica',
+                'params' : {
+                    'snapshotUrl' : 'file://' + self.snapshot_dir + '/none'
+                }
+            })
+
+    def test_dataset_without_snapshot_support(self):
+        mldb.put('/v1/datasets/mutable', {'type' : 'sparse.mutable'})
+        with self.assertRaises(ResponseException):
+            self.publish('mutable')
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
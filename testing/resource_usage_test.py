@@ -0,0 +1,72 @@
+#
+# resource_usage_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check the resources reported for queries and procedure runs.
+#
+
+import json
+import os
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class ResourceUsageTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(100):
+            ds.record_row('row%d' % i, [['x', i, 0], ['y', i % 3, 0]])
+        ds.commit()
+
+    def test_query_header(self):
+        resp = mldb.get('/v1/query', q='SELECT x FROM ds',
+                        resourceUsage='true')
+        self.assertEqual(len(resp.json()), 100)
+        resources = json.loads(resp.headers['X-MLDB-Resource-Usage'])
+        self.assertGreaterEqual(resources['cpuSeconds'], 0)
+        self.assertGreaterEqual(resources['seconds'], 0)
+        self.assertEqual(resources['rowsScanned'], {'ds': 100})
+        self.assertIn('bytesAllocated', resources['memory'])
+
+    def test_no_header_by_default(self):
+        resp = mldb.get('/v1/query', q='SELECT x FROM ds')
+        self.assertNotIn('X-MLDB-Resource-Usage', resp.headers)
+
+    def test_explain(self):
+        plan = mldb.get('/v1/query', q='SELECT x FROM ds',
+                        explain='true').json()
+        resources = plan['details']['resources']
+        self.assertEqual(resources['rowsScanned'], {'ds': 100})
+        self.assertEqual(plan['details']['memory'], resources['memory'])
+
+    def test_procedure_run(self):
+        resp = mldb.post('/v1/procedures', {
+            'type': 'transform',
+            'params': {
+                'inputData': 'SELECT x * 2 AS x2 FROM ds',
+                'outputDataset': 'ds_out',
+                'runOnCreation': True
+            }
+        }).json()
+        resources = resp['status']['firstRun']['resources']
+        self.assertEqual(resources['rowsScanned'], {'ds': 100})
+        self.assertGreaterEqual(resources['cpuSeconds'], 0)
+
+    def test_bytes_read(self):
+        resp = mldb.post('/v1/procedures', {
+            'type': 'import.json',
+            'params': {
+                'dataFileUrl':
+                    'file://mldb/testing/dataset/json_dataset.json',
+                'outputDataset': 'imported',
+                'runOnCreation': True
+            }
+        }).json()
+        resources = resp['status']['firstRun']['resources']
+        self.assertGreaterEqual(resources['bytesRead']['file'],
+                                os.path.getsize('mldb/testing/dataset/'
+                                                'json_dataset.json'))
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,66 @@
+#
+# rowname_merge_join_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Test of joins on row names, which are merged on the row hashes of the two
+# sides.  The results must be the same as for the hash join that is used
+# for any other equijoin.
+#
+
+from mldb import mldb, MldbUnitTest
+
+class RowNameMergeJoinTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        # Enough rows for the ranges to be merged in parallel, with some
+        # rows only on one side
+        for name, first, last in [('left_ds', 0, 12000),
+                                  ('right_ds', 6000, 18000)]:
+            ds = mldb.create_dataset({'id': name, 'type': 'tabular'})
+            for i in range(first, last):
+                ds.record_row('row{}'.format(i), [['x', i, 0]])
+            ds.commit()
+
+    def check_join(self, kind, func):
+        merged = mldb.query("""
+            SELECT l.x, r.x FROM left_ds AS l
+            {0} JOIN right_ds AS r ON l.{1}() = r.{1}()
+            ORDER BY rowName()
+        """.format(kind, func))
+        hashed = mldb.query("""
+            SELECT l.x, r.x FROM left_ds AS l
+            {0} JOIN right_ds AS r ON l.rowName() + '' = r.rowName() + ''
+            ORDER BY rowName()
+        """.format(kind, func))
+        self.assertEqual(merged, hashed)
+        return merged
+
+    def test_inner(self):
+        res = self.check_join('INNER', 'rowName')
+        self.assertEqual(len(res), 6001)
+
+    def test_left(self):
+        res = self.check_join('LEFT', 'rowName')
+        self.assertEqual(len(res), 12001)
+
+    def test_right(self):
+        res = self.check_join('RIGHT', 'rowPath')
+        self.assertEqual(len(res), 12001)
+
+    def test_full(self):
+        res = self.check_join('FULL', 'rowName')
+        self.assertEqual(len(res), 18001)
+
+    def test_chained(self):
+        # The second join is on the row names of a table within the joined
+        # side, which aren't those of the side itself
+        res = mldb.query("""
+            SELECT count(*) AS n FROM left_ds AS a
+            JOIN right_ds AS b ON a.rowName() = b.rowName()
+            JOIN left_ds AS c ON c.rowName() = a.rowName()
+        """)
+        self.assertEqual(res[1][1], 6000)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,98 @@
+#
+# script_function_workers_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Python script functions run in a pool of worker processes.
+#
+from mldb import mldb, MldbUnitTest, ResponseException
+
+SOURCE = """
+from mldb import mldb
+import os
+results = []
+for colName, cell in mldb.script.args[0]:
+    cellValue, cellTs = cell
+    results.append([colName, cellValue * 2, cellTs])
+results.append(['pid', os.getpid(), cellTs])
+mldb.script.set_return(results)
+"""
+
+
+class ScriptFunctionWorkersTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'nums', 'type' : 'sparse.mutable'})
+        for i in range(200):
+            ds.record_row('r%d' % i, [['x', i, 0], ['y', -i, 0]])
+        ds.commit()
+
+        for execution in ['inProcess', 'workers']:
+            mldb.put('/v1/functions/double_' + execution, {
+                'type' : 'script.apply',
+                'params' : {
+                    'language' : 'python',
+                    'scriptConfig' : {'source' : SOURCE},
+                    'execution' : execution,
+                    'numWorkers' : 4,
+                    'batchSize' : 16
+                }
+            })
+
+    def apply(self, execution, args):
+        res = mldb.get('/v1/functions/double_%s/application' % execution,
+                       input={'args' : args}, outputFormat='json').json()
+        return res['return']
+
+    def test_same_as_in_process(self):
+        args = {'x' : 3, 'y' : 'abc'}
+        expected = self.apply('inProcess', args)
+        result = self.apply('workers', args)
+        self.assertEqual(result['x'], expected['x'])
+        self.assertEqual(result['y'], expected['y'])
+        self.assertEqual(result['x'], 6)
+
+    def test_query(self):
+        res = mldb.query("""
+            SELECT sum(double_workers({args: {x, y}})[return].x) AS x,
+                   count(distinct double_workers({args: {x, y}})[return].pid)
+                       AS workers
+            FROM nums
+        """)
+        self.assertEqual(res[1][1], 2 * sum(range(200)))
+        self.assertLessEqual(res[1][2], 4)
+
+    def test_batch(self):
+        inputs = [{'args' : {'x' : i}} for i in range(100)]
+        batch = mldb.get('/v1/functions/double_workers/batch',
+                         input=inputs).json()
+        self.assertEqual([b['return']['x'] for b in batch],
+                         [2 * i for i in range(100)])
+
+    def test_script_error(self):
+        mldb.put('/v1/functions/broken', {
+            'type' : 'script.apply',
+            'params' : {
+                'language' : 'python',
+                'scriptConfig' : {'source' : 'raise ValueError("oops")'},
+                'execution' : 'workers'
+            }
+        })
+        with self.assertRaisesRegex(ResponseException, 'oops'):
+            mldb.get('/v1/functions/broken/application',
+                     input={'args' : {'x' : 1}})
+
+    def test_javascript_not_supported(self):
+        with self.assertRaises(ResponseException):
+            mldb.put('/v1/functions/js_workers', {
+                'type' : 'script.apply',
+                'params' : {
+                    'language' : 'javascript',
+                    'scriptConfig' : {'source' : '1'},
+                    'execution' : 'workers'
+                }
+            })
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,62 @@
+#
+# signal_functions_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Batches of signals passed to fft() and the frames of stft() give the same
+# results as transforming each signal on its own.
+#
+from mldb import mldb, MldbUnitTest, ResponseException
+
+
+class SignalFunctionsTest(MldbUnitTest):  # noqa
+
+    def value(self, expr):
+        return mldb.query('SELECT ' + expr + ' AS v')[1][1]
+
+    def test_batched_fft(self):
+        self.assertEqual(self.value("""
+            fft([impulse(32), shifted_impulse(32, 1), shifted_impulse(32, 5)])
+            = [fft(impulse(32)), fft(shifted_impulse(32, 1)),
+               fft(shifted_impulse(32, 5))]"""), 1)
+
+    def test_batched_inverse(self):
+        self.assertEqual(self.value("""
+            quantize(fft(fft([shifted_impulse(64, 3), shifted_impulse(64, 60)]),
+                         'backward'), 0.001)
+            = [shifted_impulse(64, 3), shifted_impulse(64, 60)]"""), 1)
+
+    def test_shape(self):
+        res = mldb.get('/v1/query', q='SELECT fft(impulse(64)) AS f',
+                       format='table').json()
+        self.assertEqual(len(res[0]) - 1, 64)
+        self.assertEqual(res[0][1], 'f.0.0')
+        self.assertEqual(res[0][-1], 'f.31.1')
+
+    def test_stft(self):
+        signal = 'concat(impulse(32), shifted_impulse(32, 1))'
+        self.assertEqual(self.value("""
+            stft({0}, 32) = [fft(impulse(32)), fft(shifted_impulse(32, 1))]
+            """.format(signal)), 1)
+
+        # Overlapping frames
+        self.assertEqual(self.value("""
+            stft(concat(impulse(32), impulse(32)), 32, 16)
+            = [fft(impulse(32)), fft(shifted_impulse(32, 16)),
+               fft(impulse(32))]"""), 1)
+
+        # Frames that aren't aligned in memory
+        self.assertEqual(self.value("""
+            stft(shifted_impulse(34, 1), 32, 1)
+            = [fft(shifted_impulse(32, 1)), fft(impulse(32)),
+               fft(reshape([], [32], 0))]"""), 1)
+
+    def test_errors(self):
+        with self.assertRaises(ResponseException):
+            self.value('fft(impulse(33))')
+        with self.assertRaises(ResponseException):
+            self.value('stft(impulse(16), 32)')
+        with self.assertRaises(ResponseException):
+            self.value('stft(impulse(64), 30)')
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,95 @@
+#
+# sql_function_batch_apply_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that applying sql.expression and sql.query functions to a batch of
+# inputs through the /batch route gives the same results as applying them
+# one at a time.
+#
+from mldb import mldb, MldbUnitTest
+
+class SqlFunctionBatchApplyTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'lookup', 'type' : 'sparse.mutable'})
+        for i in range(10):
+            ds.record_row('r%d' % i, [['k', i, 0], ['v', i * i, 0]])
+        ds.commit()
+
+        for prepared in [True, False]:
+            mldb.put('/v1/functions/expr_%s' % prepared, {
+                'type' : 'sql.expression',
+                'params' : {
+                    'expression' : 'x + 1 AS y, x * 2 AS z, '
+                                   "lower(s) AS s",
+                    'prepared' : prepared
+                }
+            })
+
+        mldb.put('/v1/functions/expr_raw', {
+            'type' : 'sql.expression',
+            'params' : {
+                'expression' : 'x * x',
+                'raw' : True,
+                'autoInput' : True
+            }
+        })
+
+        mldb.put('/v1/functions/query', {
+            'type' : 'sql.query',
+            'params' : {
+                'query' : 'SELECT v FROM lookup WHERE k = $k'
+            }
+        })
+
+    def check(self, name, inputs):
+        batch = mldb.get('/v1/functions/%s/batch' % name,
+                         input=inputs).json()
+        self.assertEqual(len(batch), len(inputs))
+        for input, output in zip(inputs, batch):
+            one = mldb.get('/v1/functions/%s/application' % name,
+                           input=input, outputFormat='json').json()
+            self.assertEqual(output, one)
+        return batch
+
+    def test_expression(self):
+        inputs = [{'x' : i, 's' : 'ABC%d' % i} for i in range(500)]
+        inputs.append({'x' : None})
+        for prepared in [True, False]:
+            batch = self.check('expr_%s' % prepared, inputs)
+            self.assertEqual(batch[7], {'y' : 8, 'z' : 14, 's' : 'abc7'})
+
+    def test_raw_auto_input(self):
+        batch = mldb.get('/v1/functions/expr_raw/batch',
+                         input=list(range(300))).json()
+        self.assertEqual(batch, [i * i for i in range(300)])
+
+    def test_query(self):
+        batch = self.check('query', [{'k' : i} for i in range(12)])
+        self.assertEqual(batch[3], {'v' : 9})
+        self.assertEqual(batch[11], {'v' : None})
+
+    def test_info_is_stable(self):
+        # The function info of an unprepared expression is kept between
+        # calls, but a new function must still be seen
+        mldb.put('/v1/functions/double_it', {
+            'type' : 'sql.expression',
+            'params' : {'expression' : 'x * 2 AS y'}
+        })
+        mldb.put('/v1/functions/expr_nested', {
+            'type' : 'sql.expression',
+            'params' : {'expression' : 'double_it({x})[y] AS y'}
+        })
+        self.check('expr_nested', [{'x' : 1}, {'x' : 2}])
+        mldb.delete('/v1/functions/double_it')
+        mldb.put('/v1/functions/double_it', {
+            'type' : 'sql.expression',
+            'params' : {'expression' : 'x * 3 AS y'}
+        })
+        res = mldb.get('/v1/functions/expr_nested/application',
+                       input={'x' : 2}, outputFormat='json').json()
+        self.assertEqual(res, {'y' : 6})
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,110 @@
+#
+# sql_like_regex_fastpath_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Tests that LIKE and the regex functions give the same results when they
+# are matched without running the regex engine, and when the pattern isn't
+# constant.
+#
+
+from mldb import mldb, MldbUnitTest
+
+class SqlLikeRegexFastpathTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'strings', 'type' : 'sparse.mutable'})
+        values = ['abc', 'abcdef', 'xabc', 'xabcx', 'ab', '', 'a.c', 'aXbYc',
+                  'café', 'helloworld', 'hello.world']
+        patterns = ['abc', 'abc%', '%abc', '%abc%', 'a%b%c', '%', 'a_c',
+                    'a.c', '%é', 'hello.%']
+        for i, v in enumerate(values):
+            ds.record_row('r%d' % i,
+                          [['v', v, 0],
+                           ['pattern', patterns[i % len(patterns)], 0]])
+        ds.commit()
+
+    def result(self, expr, where='true'):
+        res = mldb.query(
+            "SELECT {} AS x FROM strings WHERE {} ORDER BY v".format(expr,
+                                                                     where))
+        return [r[1] for r in res[1:]]
+
+    def test_like_constant(self):
+        def like(pattern):
+            res = mldb.query(
+                "SELECT v FROM strings WHERE v LIKE '{}' ORDER BY v"
+                .format(pattern))
+            return [r[1] for r in res[1:]]
+
+        self.assertEqual(like('abc'), ['abc'])
+        self.assertEqual(like('abc%'), ['abc', 'abcdef'])
+        self.assertEqual(like('%abc'), ['abc', 'xabc'])
+        self.assertEqual(like('%abc%'), ['abc', 'abcdef', 'xabc', 'xabcx'])
+        self.assertEqual(like('a%b%c'), ['aXbYc', 'abc'])
+        self.assertEqual(like('a%c'), ['a.c', 'aXbYc', 'abc'])
+        self.assertEqual(like('%%'), like('%'))
+        self.assertEqual(len(like('%')), 11)
+        self.assertEqual(like('a.c'), ['a.c'])
+        self.assertEqual(like('a_c'), ['a.c', 'abc'])
+        self.assertEqual(like('caf_'), ['café'])
+        self.assertEqual(like('%é'), ['café'])
+        self.assertEqual(like(''), [''])
+
+    def test_not_like(self):
+        self.assertEqual(
+            self.result("v NOT LIKE 'abc%'", "v LIKE '%abc%'"),
+            [False, False, True, True])
+
+    def test_like_newline(self):
+        self.assertTableResultEquals(
+            mldb.query("SELECT 'a\nb' LIKE 'a%' AS x, 'a\nb' LIKE '%b' AS y"),
+            [["_rowName", "x", "y"],
+             ["result", True, True]])
+
+    def test_like_column_pattern(self):
+        # The pattern varies from row to row, so it can't be precompiled
+        res = mldb.query("SELECT v LIKE pattern AS x FROM strings")
+        got = dict((r[0], r[1]) for r in res[1:])
+        self.assertEqual(got, {
+            'r0': True,    # 'abc' LIKE 'abc'
+            'r1': True,    # 'abcdef' LIKE 'abc%'
+            'r2': True,    # 'xabc' LIKE '%abc'
+            'r3': True,    # 'xabcx' LIKE '%abc%'
+            'r4': False,   # 'ab' LIKE 'a%b%c'
+            'r5': True,    # '' LIKE '%'
+            'r6': True,    # 'a.c' LIKE 'a_c'
+            'r7': False,   # 'aXbYc' LIKE 'a.c'
+            'r8': True,    # 'café' LIKE '%é'
+            'r9': False,   # 'helloworld' LIKE 'hello.%'
+            'r10': False,  # 'hello.world' LIKE 'abc'
+        })
+
+    def test_regex_literals(self):
+        self.assertEqual(
+            self.result("regex_search(v, 'hello')", "v LIKE 'hello%'"),
+            [True, True])
+        self.assertEqual(
+            self.result("regex_match(v, 'hello\\.world')", "v LIKE 'hello%'"),
+            [True, False])
+        self.assertEqual(
+            self.result("regex_match(v, 'hel+o.*')", "v LIKE 'hello%'"),
+            [True, True])
+        self.assertEqual(
+            self.result("regex_search(v, 'lo|xyz')", "v LIKE 'hello%'"),
+            [True, True])
+        self.assertEqual(
+            self.result("regex_replace(v, 'o\\.w', '-')", "v LIKE 'hello%'"),
+            ['hell-orld', 'helloworld'])
+
+    def test_regex_column_pattern(self):
+        # Many rows with few distinct patterns use the cache of compiled
+        # regexes.  Here the LIKE patterns are used as regexes.
+        res = mldb.query("SELECT regex_search(v, pattern) AS x FROM strings")
+        got = dict((r[0], r[1]) for r in res[1:])
+        self.assertEqual(got['r0'], True)   # 'abc' contains 'abc'
+        self.assertEqual(got['r2'], False)  # 'xabc' doesn't contain '%abc'
+        self.assertEqual(got['r7'], False)  # 'aXbYc' doesn't contain 'a.c'
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,99 @@
+#
+# sql_shared_subexpression_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that calls repeated within a query, which are only calculated once
+# per row, still give the result for each row.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class SqlSharedSubexpressionTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(10):
+            ds.record_row('row%d' % i,
+                          [['j', '{"a": %d, "b": %d}' % (i % 3, i), 0],
+                           ['x', i, 0]])
+        ds.commit()
+
+    def test_select(self):
+        self.assertTableResultEquals(
+            mldb.query("""
+                SELECT parse_json(j).a AS a, parse_json(j).b AS b,
+                       parse_json(j).b * 2 AS c
+                FROM ds
+                WHERE parse_json(j).b < 4
+                ORDER BY parse_json(j).b
+            """),
+            [["_rowName", "a", "b", "c"],
+             ["row0", 0, 0, 0],
+             ["row1", 1, 1, 2],
+             ["row2", 2, 2, 4],
+             ["row3", 0, 3, 6]])
+
+    def test_group_by(self):
+        self.assertTableResultEquals(
+            mldb.query("""
+                SELECT parse_json(j).a AS a, sum(parse_json(j).b) AS total,
+                       count(*) AS n
+                FROM ds
+                GROUP BY parse_json(j).a
+                ORDER BY parse_json(j).a
+            """),
+            [["_rowName", "a", "n", "total"],
+             ["[0]", 0, 4, 18],
+             ["[1]", 1, 3, 12],
+             ["[2]", 2, 3, 15]])
+
+    def test_different_arguments(self):
+        # Calls to the same function with different arguments aren't shared
+        self.assertTableResultEquals(
+            mldb.query("""
+                SELECT abs(x - 5) AS d1, abs(x - 4) AS d2, abs(x - 5) AS d3
+                FROM ds
+                WHERE x < 2
+                ORDER BY x
+            """),
+            [["_rowName", "d1", "d2", "d3"],
+             ["row0", 5, 4, 5],
+             ["row1", 4, 3, 4]])
+
+    def test_function_body(self):
+        # The body of a function is bound in its own scope, so it doesn't
+        # share with the query that calls it
+        mldb.put('/v1/functions/getb', {
+            'type': 'sql.expression',
+            'params': {
+                'expression': 'parse_json(j).b + 100 AS b'
+            }
+        })
+
+        self.assertTableResultEquals(
+            mldb.query("""
+                SELECT parse_json(j).b AS b, getb({j}).b AS b100
+                FROM ds
+                WHERE x < 2
+                ORDER BY x
+            """),
+            [["_rowName", "b", "b100"],
+             ["row0", 0, 100],
+             ["row1", 1, 101]])
+
+    def test_constant(self):
+        # Constant calls are folded rather than shared
+        self.assertTableResultEquals(
+            mldb.query("""
+                SELECT x, parse_json('{"a": 1}').a AS one
+                FROM ds
+                WHERE x < parse_json('{"a": 2}').a
+                ORDER BY x
+            """),
+            [["_rowName", "one", "x"],
+             ["row0", 1, 0],
+             ["row1", 1, 1]])
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,111 @@
+#
+# sql_sketch_aggregators_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Tests for the approximate aggregators and their mergeable sketches.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class SqlSketchAggregatorsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'events', 'type' : 'sparse.mutable'})
+        for i in range(5000):
+            ds.record_row('e%d' % i,
+                          [['user', 'u%d' % (i % 1000), 0],
+                           ['day', i % 7, 0],
+                           ['x', i % 101, 0],
+                           ['page', 'p%d' % cls.page(i), 0]])
+        ds.commit()
+
+    @staticmethod
+    def page(i):
+        # p0 for 70% of the events, p1 for 20% and p2 for 10%
+        return 0 if i % 10 < 7 else 1 if i % 10 < 9 else 2
+
+    def scalar(self, query):
+        return mldb.query(query)[1][1]
+
+    def row(self, query):
+        res = mldb.query(query)
+        return dict(zip(res[0][1:], res[1][1:]))
+
+    def test_approx_count_distinct(self):
+        est = self.scalar('SELECT approx_count_distinct(user) FROM events')
+        self.assertAlmostEqual(est, 1000, delta=30)
+
+        # Small counts are exact
+        self.assertEqual(
+            self.scalar('SELECT approx_count_distinct(day) FROM events'), 7)
+
+        res = mldb.query('SELECT approx_count_distinct(user) AS approx, '
+                         'count_distinct(user) AS exact '
+                         'FROM events GROUP BY day ORDER BY day')
+        self.assertEqual(len(res), 8)
+        for row in res[1:]:
+            self.assertAlmostEqual(row[1], row[2], delta=0.03 * row[2])
+
+    def test_approx_quantile(self):
+        self.assertAlmostEqual(
+            self.scalar('SELECT approx_quantile(x, 0.5) FROM events'),
+            50, delta=1)
+        self.assertAlmostEqual(
+            self.scalar('SELECT approx_median(x) FROM events'), 50, delta=1)
+        self.assertAlmostEqual(
+            self.scalar('SELECT approx_quantile(x, 0.9) FROM events'),
+            90, delta=1.5)
+        self.assertEqual(
+            self.scalar('SELECT approx_quantile(x, 0) FROM events'), 0)
+        self.assertEqual(
+            self.scalar('SELECT approx_quantile(x, 1) FROM events'), 100)
+
+        with self.assertRaises(ResponseException):
+            mldb.query('SELECT approx_quantile(x, 2) FROM events')
+
+    def test_approx_top_k(self):
+        self.assertEqual(
+            self.row('SELECT approx_top_k(page, 2) AS * FROM events'),
+            {'p0' : 3500, 'p1' : 1000})
+
+    def test_merge_sketches(self):
+        # Sketches per day, stored in a dataset and merged later, give the
+        # same answer as a sketch of the whole
+        mldb.post('/v1/procedures', {
+            'type' : 'transform',
+            'params' : {
+                'inputData' : """
+                    SELECT hll_sketch(user) AS users,
+                           tdigest_sketch(x) AS xs,
+                           top_k_sketch(page, 2) AS pages
+                    FROM events GROUP BY day
+                """,
+                'outputDataset' : 'daily_sketches',
+                'runOnCreation' : True
+            }
+        })
+
+        self.assertEqual(
+            self.scalar('SELECT hll_estimate(hll_merge(users)) '
+                        'FROM daily_sketches'),
+            self.scalar('SELECT approx_count_distinct(user) FROM events'))
+
+        self.assertAlmostEqual(
+            self.scalar('SELECT tdigest_quantile(tdigest_merge(xs), 0.5) '
+                        'FROM daily_sketches'),
+            50, delta=1)
+
+        self.assertEqual(
+            self.row('SELECT top_k_values(top_k_merge(pages)) AS * '
+                     'FROM daily_sketches'),
+            {'p0' : 3500, 'p1' : 1000})
+
+        # A sketch of one kind isn't accepted as another
+        with self.assertRaises(ResponseException):
+            mldb.query('SELECT tdigest_merge(users) FROM daily_sketches')
+        with self.assertRaises(ResponseException):
+            mldb.query("SELECT hll_estimate('not a sketch')")
+
+if __name__ == '__main__':
+    mldb.run_tests()
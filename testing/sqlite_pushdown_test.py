@@ -0,0 +1,79 @@
+#
+# sqlite_pushdown_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that queries of a sqliteSparse dataset, whose WHERE clauses,
+# projections and count() aggregators are run by SQLite, give the same
+# results as over a sparse.mutable dataset.
+#
+from mldb import mldb, MldbUnitTest
+
+
+class SqlitePushdownTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        rows = [
+            ['r0', [['x', 1, 0], ['y', 'abc', 0]]],
+            ['r1', [['x', 2, 0], ['y', 'abd', 0]]],
+            ['r2', [['x', 'a', 0], ['y', 'xyz', 0]]],
+            ['r3', [['x', 3.5, 0]]],
+            ['r4', [['y', 'ab"c', 0]]],
+            ['r5', [['x', 1, 0], ['z', 5, 0]]],
+            ['r6', [['x', -4, 0], ['y', 'ABC', 0]]],
+            ['r7', [['x', '1', 0]]],
+            ['r8', [['z', 1, 0], ['w.a', 1, 0]]],
+        ]
+        for dataset_type, dataset_id in [('sqliteSparse', 'lite'),
+                                          ('sparse.mutable', 'mem')]:
+            ds = mldb.create_dataset({'id' : dataset_id,
+                                      'type' : dataset_type})
+            for name, values in rows:
+                ds.record_row(name, values)
+            ds.commit()
+
+    def check(self, query):
+        expected = mldb.query(query.format(ds='mem'))
+        self.assertTableResultEquals(mldb.query(query.format(ds='lite')),
+                                     expected, query)
+
+    def test_where(self):
+        for where in ["x = 1", "x != 1", "x = '1'", "x = 'a'",
+                      "x IN (1, 'a')", "x NOT IN (1, 2)",
+                      "x IS NULL", "x IS NOT NULL",
+                      "x > 1", "x <= 2", "1 < x", "x BETWEEN -4 AND 2",
+                      "y LIKE 'ab%'", "y LIKE 'ab\"%'",
+                      "rowName() = 'r3'", "rowName() = 3",
+                      "NOT (x = 1)", "NOT (x IS NULL)",
+                      "x = 1 OR y = 'abc'", "x = 1 AND z = 5",
+                      "x = 1 AND z + 1 > 2", "unknown = 1",
+                      "unknown IS NULL", "w = 1", "w.a = 1", "true",
+                      "false"]:
+            self.check('SELECT * FROM {ds} WHERE ' + where
+                       + ' ORDER BY rowName()')
+
+    def test_limit(self):
+        self.check('SELECT * FROM {ds} WHERE x IS NOT NULL '
+                   'ORDER BY rowName() LIMIT 2 OFFSET 1')
+
+    def test_projection(self):
+        self.check('SELECT x, z FROM {ds} ORDER BY rowName()')
+        self.check('SELECT w FROM {ds} WHERE z IS NOT NULL '
+                   'ORDER BY rowName()')
+        self.check('SELECT rowName() AS name FROM {ds} ORDER BY rowName()')
+
+    def test_count(self):
+        for query in ['SELECT count(*) AS n FROM {ds}',
+                      'SELECT count(x) AS n FROM {ds}',
+                      'SELECT count(*) AS n, count(y) AS m FROM {ds} '
+                      'WHERE x = 1',
+                      'SELECT count(*) AS n FROM {ds} WHERE x = 10',
+                      'SELECT count(unknown) AS n FROM {ds}',
+                      'SELECT count(*) + 1 AS n FROM {ds} WHERE x IS NULL',
+                      'SELECT count(*) AS n FROM {ds} HAVING count(*) > 100',
+                      'SELECT count(*) AS n FROM {ds} WHERE x > 1']:
+            self.check(query)
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
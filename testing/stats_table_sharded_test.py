@@ -0,0 +1,108 @@
+#
+# stats_table_sharded_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that the per-thread counts of statsTable.bagOfWords.train add up
+# to the same totals as counting in order, and that the saved tables give
+# the same counts when loaded back by the functions.
+#
+import random
+from collections import defaultdict
+from mldb import mldb, MldbUnitTest
+
+NUM_ROWS = 20000
+NUM_WORDS = 3000
+
+class StatsTableShardedTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        cls.trials = defaultdict(int)
+        cls.labels = defaultdict(int)
+
+        ds = mldb.create_dataset({'id' : 'docs', 'type' : 'sparse.mutable'})
+        for i in range(NUM_ROWS):
+            words = set('w%d' % random.randint(0, NUM_WORDS)
+                        for _ in range(random.randint(1, 10)))
+            label = random.random() < 0.3
+            for w in words:
+                cls.trials[w] += 1
+                cls.labels[w] += label
+            cols = [['text', ' '.join(sorted(words)), 0]]
+            if label:
+                cols.append(['label', 1, 0])
+            ds.record_row('row%d' % i, cols)
+        ds.commit()
+
+        mldb.put('/v1/procedures/bow', {
+            'type' : 'statsTable.bagOfWords.train',
+            'params' : {
+                'trainingData' : "select tokenize(text, {splitChars: ' '}) "
+                                 "as * from docs",
+                'outcomes' : [['label', 'label IS NOT NULL']],
+                'outputDataset' : 'bow_counts',
+                'statsTableFileUrl' :
+                    'file://tmp/stats_table_sharded_test_bow.st',
+                'runOnCreation' : True
+            }
+        })
+
+    def test_counts_match(self):
+        rows = mldb.query('select * from bow_counts')
+        header = rows[0]
+        trials = header.index('trials')
+        label = header.index('outcome.label')
+        self.assertEqual(len(rows) - 1, len(self.trials))
+        for row in rows[1:]:
+            self.assertEqual(row[trials], self.trials[row[0]])
+            self.assertEqual(row[label], self.labels[row[0]])
+
+    def test_posneg_from_saved_table(self):
+        mldb.put('/v1/functions/posneg', {
+            'type' : 'statsTable.bagOfWords.posneg',
+            'params' : {
+                'numPos' : 5,
+                'numNeg' : 5,
+                'minTrials' : 10,
+                'outcomeToUse' : 'label',
+                'statsTableFileUrl' :
+                    'file://tmp/stats_table_sharded_test_bow.st'
+            }
+        })
+
+        probs = {}
+        for w, n in self.trials.items():
+            if n >= 10:
+                probs[w] = self.labels[w] / float(n)
+        top = max(probs, key=lambda w: probs[w])
+
+        res = mldb.query("select posneg({words: {%s: 1}}) as *" % top)
+        self.assertAlmostEqual(res[1][1], probs[top], places=5)
+
+    def test_get_counts_from_saved_tables(self):
+        mldb.put('/v1/procedures/st', {
+            'type' : 'statsTable.train',
+            'params' : {
+                'trainingData' : "select text from docs",
+                'outcomes' : [['label', 'label IS NOT NULL']],
+                'outputDataset' : 'st_out',
+                'statsTableFileUrl' :
+                    'file://tmp/stats_table_sharded_test.st',
+                'functionName' : 'getCounts',
+                'runOnCreation' : True
+            }
+        })
+
+        res = mldb.query("""
+            select getCounts({keys: {text: text}}) as *, text
+            from docs where rowName() = 'row0'
+        """)
+        text = res[1][res[0].index('text')]
+        expected = len(mldb.query(
+            "select * from docs where text = '%s'" % text)) - 1
+        self.assertEqual(res[1][res[0].index('counts.trial.text')],
+                         expected)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -207,6 +207,37 @@ class SummaryStatsProcTest(MldbUnitTest):  # noqa
         ])
 
 
+    def test_many_rows_match_sql(self):
+        ds = mldb.create_dataset({'id' : 'many_rows', 'type' : 'tabular'})
+        for i in range(5000):
+            ds.record_row('r%d' % i, [['x', i % 97, 0], ['y', i % 3 * 0.5, 0],
+                                      ['skip', i, 0]])
+        ds.commit()
+
+        mldb.post('/v1/procedures', {
+            'type' : 'summary.statistics',
+            'params' : {
+                'runOnCreation' : True,
+                'inputData' :
+                    'SELECT * EXCLUDING (skip) FROM many_rows WHERE x < 50',
+                'outputDataset' : {'id' : 'many_rows_stats',
+                                   'type' : 'sparse.mutable'}
+            }
+        })
+
+        res = mldb.query("""
+            SELECT value.min, value.max, value.avg, value.num_unique,
+                   value.num_null
+            FROM many_rows_stats ORDER BY rowName()""")
+        expected = mldb.query("""
+            SELECT min(x), max(x), avg(x), count_distinct(x), 0,
+                   min(y), max(y), avg(y), count_distinct(y), 0
+            FROM many_rows WHERE x < 50""")[1][1:]
+        self.assertEqual([r[0] for r in res[1:]], ['x', 'y'])
+        self.assertEqual(res[1][1:], expected[:5])
+        self.assertEqual(res[2][1:4], expected[5:8])
+        self.assertEqual(res[2][4:], expected[8:])
+
 
 if __name__ == '__main__':
     mldb.run_tests()
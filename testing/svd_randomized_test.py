@@ -0,0 +1,81 @@
+#
+# svd_randomized_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that the randomized svd.train algorithm finds the same top singular
+# values as the default lanczos algorithm.
+#
+import datetime
+import gzip
+import json
+import random
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class SvdRandomizedTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        # Low rank numeric columns plus noise, and some categorical columns
+        # driven by the same factors
+        random.seed(1)
+        ds = mldb.create_dataset({'id' : 'lowrank', 'type' : 'sparse.mutable'})
+        ts = datetime.datetime.now().isoformat(' ')
+        loadings = [[random.gauss(0, 1) for _ in range(4)] for _ in range(40)]
+        for i in range(1000):
+            factors = [random.gauss(0, 4 - f) for f in range(4)]
+            row = []
+            for j, loading in enumerate(loadings):
+                value = sum(l * f for l, f in zip(loading, factors))
+                row.append(['x%d' % j, value + random.gauss(0, 0.1), ts])
+            for j in range(10):
+                if factors[j % 4] > 0.5:
+                    row.append(['cat%d' % j, 'yes', ts])
+            ds.record_row('row%d' % i, row)
+        ds.commit()
+
+    def train(self, algorithm, **kwargs):
+        url = 'file://tmp/svd_randomized_%s.svd.json.gz' % algorithm
+        params = {
+            'trainingData' : 'SELECT * FROM lowrank',
+            'modelFileUrl' : url,
+            'numSingularValues' : 10,
+            'numDenseBasisVectors' : 100,
+            'algorithm' : algorithm,
+            'columnOutputDataset' : 'svd_randomized_%s_cols' % algorithm,
+            'runOnCreation' : True
+        }
+        params.update(kwargs)
+        mldb.put('/v1/procedures/svd_randomized_' + algorithm, {
+            'type' : 'svd.train',
+            'params' : params
+        })
+        with gzip.open(url[len('file://'):]) as f:
+            return json.loads(f.read())
+
+    def test_same_singular_values(self):
+        lanczos = self.train('lanczos')
+        randomized = self.train('randomized', oversampling=10,
+                                powerIterations=3)
+
+        self.assertEqual(len(randomized['columns']),
+                         len(lanczos['columns']))
+
+        # The top singular values are well separated and so must agree
+        # closely; the rest is mostly noise
+        for l, r in zip(lanczos['singularValues'][:6],
+                        randomized['singularValues'][:6]):
+            self.assertAlmostEqual(l, r, delta=l * 0.01)
+
+        # It can be used to embed the columns
+        res = mldb.query('SELECT * FROM svd_randomized_randomized_cols '
+                         'WHERE rowName() = \'x0\'')
+        self.assertEqual(len(res[1]), 11)
+
+    def test_validation(self):
+        with self.assertRaises(ResponseException):
+            self.train('randomized', oversampling=-1)
+        with self.assertRaises(ResponseException):
+            self.train('randomized', powerIterations=-1)
+
+if __name__ == '__main__':
+    mldb.run_tests()
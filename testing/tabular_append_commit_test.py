@@ -0,0 +1,60 @@
+#
+# tabular_append_commit_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Repeated append and commit cycles on a tabular dataset.  Each commit
+# publishes a new version of the dataset without freezing the chunks of
+# the previous ones again.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class TabularAppendCommitTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def append(cls, first, n):
+        for i in range(first, first + n):
+            mldb.post('/v1/datasets/appended/rows', {
+                "rowName": "row%d" % i,
+                "columns": [["x", i, 0], ["y", i % 5, 0]]
+            })
+        mldb.post('/v1/datasets/appended/commit')
+
+    def status(self):
+        return mldb.get('/v1/datasets/appended').json()['status']
+
+    def test_append_commit(self):
+        mldb.put('/v1/datasets/appended', { "type": "tabular" })
+
+        for cycle in range(5):
+            self.append(cycle * 100, 100)
+
+            status = self.status()
+            self.assertEqual(status['version'], cycle + 1)
+            self.assertEqual(status['rowCount'], (cycle + 1) * 100)
+
+            # Only the new chunks were frozen
+            self.assertEqual(status['chunkCount'],
+                             status['freeze']['chunksFrozen'])
+
+            res = mldb.query("SELECT count(*), sum(x) FROM appended")
+            n = (cycle + 1) * 100
+            self.assertEqual(res[1][1:], [n, n * (n - 1) // 2])
+
+            # Rows of all of the commits can be found by name
+            res = mldb.query("SELECT x FROM appended "
+                             "WHERE rowName() IN ('row0', 'row%d')" % (n - 1))
+            self.assertEqual(sorted(r[1] for r in res[1:]), [0, n - 1])
+
+        # A commit that fails leaves the last version in place
+        with self.assertRaises(ResponseException):
+            self.append(0, 1)
+
+        status = self.status()
+        self.assertEqual(status['version'], 5)
+        self.assertEqual(status['rowCount'], 500)
+        res = mldb.query("SELECT count(*) FROM appended")
+        self.assertEqual(res[1][1], 500)
+
+if __name__ == '__main__':
+    mldb.run_tests()
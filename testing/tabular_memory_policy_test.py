@@ -0,0 +1,68 @@
+#
+# tabular_memory_policy_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# The tabular dataset's memoryPolicy chooses how frozen columns are
+# allocated.  Check that the data is the same whatever the policy, and that
+# the status reports what was done.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class TabularMemoryPolicyTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def record(cls, name, params):
+        mldb.put('/v1/datasets/' + name, {
+            "type": "tabular",
+            "params": params
+        })
+        for i in range(20000):
+            mldb.post('/v1/datasets/%s/rows' % name, {
+                "rowName": "row%d" % i,
+                "columns": [["a", i, 0], ["b", "x%d" % (i % 13), 0]]
+            })
+        mldb.post('/v1/datasets/%s/commit' % name)
+
+    @classmethod
+    def setUpClass(cls):
+        cls.record("default_policy", {})
+        cls.record("huge_pages", {
+            "memoryPolicy": {
+                "hugePages": "transparent",
+                "pageThreshold": 4096,
+                "numaPlacement": "interleave",
+                "alignment": 4096
+            }
+        })
+
+    def test_same_data(self):
+        self.assertTableResultEquals(
+            mldb.query('select * from huge_pages order by rowName()'),
+            mldb.query('select * from default_policy order by rowName()'))
+
+    def test_status(self):
+        memory = mldb.get('/v1/datasets/default_policy').json()['status']['memory']
+        self.assertEqual(memory['policy']['hugePages'], 'none')
+        self.assertEqual(memory['policy']['alignment'], 64)
+        self.assertGreater(memory['heapRegions'], 0)
+        self.assertEqual(memory['transparentHugePageRegions'], 0)
+
+        memory = mldb.get('/v1/datasets/huge_pages').json()['status']['memory']
+        self.assertEqual(memory['policy']['hugePages'], 'transparent')
+        self.assertGreater(memory['transparentHugePageRegions'], 0)
+        self.assertEqual(memory['pageRegions'], 0)
+        # Every mapped region has a placement, or a failure to place it on
+        # a machine with a single NUMA node
+        self.assertEqual(memory['numaRegions'] + memory['numaFailures'],
+                         memory['transparentHugePageRegions'])
+
+    def test_bad_alignment(self):
+        with self.assertRaises(ResponseException):
+            mldb.put('/v1/datasets/bad_alignment', {
+                "type": "tabular",
+                "params": { "memoryPolicy": { "alignment": 48 } }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
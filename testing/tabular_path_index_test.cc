@@ -0,0 +1,303 @@
+/* tabular_path_index_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test and micro-benchmark of the tabular dataset's row name index.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/tabular/path_index.h"
+#include "mldb/block/zip_serializer.h"
+#include "mldb/arch/timers.h"
+#include <iostream>
+
+using namespace std;
+
+using namespace MLDB;
+
+static Path rowName(size_t chunk, size_t row)
+{
+    return PathElement("row" + to_string(chunk) + "_" + to_string(row));
+}
+
+static MutablePathIndex
+createIndex(size_t numChunks, size_t rowsPerChunk)
+{
+    std::vector<MutablePathIndex::ChunkEntries> entries(numChunks);
+    std::vector<const MutablePathIndex::ChunkEntries *> entryPtrs;
+    for (size_t c = 0;  c < numChunks;  ++c) {
+        for (size_t r = 0;  r < rowsPerChunk;  ++r) {
+            entries[c].record(rowName(c, r), r);
+        }
+        entryPtrs.push_back(&entries[c]);
+    }
+
+    MutablePathIndex result;
+    result.add(0, entryPtrs);
+    return result;
+}
+
+static PathIndex
+freezeIndex(const MutablePathIndex & mutableIndex,
+            MappedSerializer & serializer,
+            const PathIndexParameters & params)
+{
+    PathIndex result;
+    result.layers.emplace_back
+        (std::make_shared<PathIndexLayer>
+         (mutableIndex.freeze(serializer, params).first));
+    return result;
+}
+
+/// Index built one chunk at a time, as by a series of commits
+static PathIndex
+addIndex(size_t numChunks, size_t rowsPerChunk,
+         MappedSerializer & serializer,
+         const PathIndexParameters & params)
+{
+    auto getChunkEntries = [&] (uint32_t chunk,
+                                MutablePathIndex::ChunkEntries & entries)
+        {
+            for (size_t r = 0;  r < rowsPerChunk;  ++r)
+                entries.record(rowName(chunk, r), r);
+        };
+
+    auto getRowHash = [&] (uint32_t chunk, uint32_t row)
+        {
+            return rowName(chunk, row).hash();
+        };
+
+    PathIndex result;
+    for (size_t c = 0;  c < numChunks;  ++c) {
+        MutablePathIndex::ChunkEntries entries;
+        getChunkEntries(c, entries);
+        auto collisions = result.add(serializer, c, { &entries },
+                                     getChunkEntries, getRowHash, params);
+        BOOST_CHECK(collisions.empty());
+
+        // Layers at least double in size from newest to oldest, so there
+        // are only logarithmically many
+        for (size_t i = 1;  i < result.layers.size();  ++i) {
+            BOOST_CHECK_GE(result.layers[i - 1]->numRows,
+                           2 * result.layers[i]->numRows);
+        }
+    }
+    return result;
+}
+
+static std::vector<PathIndexParameters> allParams()
+{
+    std::vector<PathIndexParameters> result;
+    for (bool bloom: { false, true }) {
+        for (bool perfect: { false, true }) {
+            PathIndexParameters params;
+            params.bloomFilter = bloom;
+            params.perfectHash = perfect;
+            result.push_back(params);
+        }
+    }
+    return result;
+}
+
+static std::string describe(const PathIndexParameters & params)
+{
+    return string(params.perfectHash ? "perfect hash" : "open addressing")
+        + (params.bloomFilter ? " with bloom filter" : "");
+}
+
+static bool
+contains(const compact_vector<std::pair<int, int>, 4> & candidates,
+         int chunk, int row)
+{
+    for (auto & c: candidates) {
+        if (c.first == chunk && c.second == row)
+            return true;
+    }
+    return false;
+}
+
+static void checkIndex(const PathIndex & index,
+                       size_t numChunks, size_t rowsPerChunk,
+                       const PathIndexParameters & params)
+{
+    for (size_t c = 0;  c < numChunks;  ++c) {
+        for (size_t r = 0;  r < rowsPerChunk;  ++r) {
+            auto candidates = index.pathPossibleChunks(rowName(c, r));
+            if (!contains(candidates, c, r)) {
+                BOOST_ERROR("row " + rowName(c, r).toUtf8String().rawString()
+                            + " not found with " + describe(params));
+                return;
+            }
+            // At most one per layer
+            if (params.perfectHash)
+                BOOST_CHECK_LE(candidates.size(), index.layers.size());
+        }
+    }
+
+    // Rows that aren't there mostly shouldn't give any candidates when
+    // there is a bloom filter or a fingerprint to reject them
+    size_t numMissing = 10000;
+    size_t numCandidates = 0;
+    for (size_t i = 0;  i < numMissing;  ++i) {
+        numCandidates
+            += index.pathPossibleChunks(rowName(numChunks + i, 0)).size();
+    }
+
+    cerr << describe(params) << ": " << 1.0 * numCandidates / numMissing
+         << " candidates per missing row, memusage "
+         << index.memusage() << endl;
+
+    if (params.bloomFilter || params.perfectHash)
+        BOOST_CHECK_LT(numCandidates, numMissing / 20);
+}
+
+BOOST_AUTO_TEST_CASE( test_empty_index )
+{
+    MemorySerializer serializer;
+    MutablePathIndex mutableIndex;
+
+    for (auto & params: allParams()) {
+        PathIndex index = freezeIndex(mutableIndex, serializer, params);
+        BOOST_CHECK(index.pathPossibleChunks(rowName(0, 0)).empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_index_lookup )
+{
+    MemorySerializer serializer;
+
+    for (size_t rowsPerChunk: { 1, 7, 1000 }) {
+        MutablePathIndex mutableIndex = createIndex(10, rowsPerChunk);
+
+        for (auto & params: allParams()) {
+            auto frozen = mutableIndex.freeze(serializer, params);
+            BOOST_CHECK(frozen.second.empty());
+            BOOST_CHECK_EQUAL(frozen.first.numRows, 10 * rowsPerChunk);
+            BOOST_CHECK_EQUAL(frozen.first.numChunks, 10);
+            PathIndex index;
+            index.layers.emplace_back
+                (std::make_shared<PathIndexLayer>(std::move(frozen.first)));
+            checkIndex(index, 10, rowsPerChunk, params);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_index_serialize )
+{
+    MemorySerializer serializer;
+    MutablePathIndex mutableIndex = createIndex(5, 1000);
+    std::string filename = "tmp/tabular_path_index_test.zip";
+
+    for (auto & params: allParams()) {
+        for (bool layered: { false, true }) {
+            PathIndex index = layered
+                ? addIndex(5, 1000, serializer, params)
+                : freezeIndex(mutableIndex, serializer, params);
+
+            {
+                ZipStructuredSerializer serializer(filename);
+                index.serialize(*serializer.newStructure("ri"));
+            }
+
+            ZipStructuredReconstituter reconstituter(Url("file://" + filename));
+            PathIndex reconstituted;
+            reconstituted.reconstitute(*reconstituter.getStructure("ri"));
+            BOOST_CHECK_EQUAL(reconstituted.layers.size(),
+                              index.layers.size());
+            checkIndex(reconstituted, 5, 1000, params);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_index_add )
+{
+    // Commit one chunk at a time, as an incremental load would
+    size_t numChunks = 100;
+    size_t rowsPerChunk = 100;
+    MemorySerializer serializer;
+
+    for (auto & params: allParams()) {
+        PathIndex index = addIndex(numChunks, rowsPerChunk, serializer,
+                                   params);
+        BOOST_CHECK_GT(index.layers.size(), 1);
+        BOOST_CHECK_LE(index.layers.size(), 8);
+        checkIndex(index, numChunks, rowsPerChunk, params);
+
+        // A row that is already in the index is reported as a collision,
+        // whether it's in a layer that is merged or one that is kept
+        auto getChunkEntries = [&] (uint32_t chunk,
+                                    MutablePathIndex::ChunkEntries & entries)
+            {
+                for (size_t r = 0;  r < rowsPerChunk;  ++r)
+                    entries.record(rowName(chunk, r), r);
+            };
+
+        auto getRowHash = [&] (uint32_t chunk, uint32_t row)
+            {
+                return rowName(chunk, row).hash();
+            };
+
+        for (size_t dup: { 0, 99 }) {
+            PathIndex copy = index;
+            MutablePathIndex::ChunkEntries entries;
+            entries.record(rowName(dup, 5), 0);
+            entries.record(rowName(numChunks, 1), 1);
+            auto collisions = copy.add(serializer, numChunks, { &entries },
+                                       getChunkEntries, getRowHash, params);
+            BOOST_REQUIRE_EQUAL(collisions.size(), 1);
+            BOOST_CHECK_EQUAL(std::get<0>(collisions[0]), dup);
+            BOOST_CHECK_EQUAL(std::get<1>(collisions[0]), 5);
+            BOOST_CHECK_EQUAL(std::get<2>(collisions[0]), numChunks);
+            BOOST_CHECK_EQUAL(std::get<3>(collisions[0]), 0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( benchmark_index_lookup )
+{
+    // Join-like workload: look up each row, and as many rows that aren't
+    // there, against an index of a million rows.
+    size_t numChunks = 8;
+    size_t rowsPerChunk = 131072;
+    MemorySerializer serializer;
+    MutablePathIndex mutableIndex = createIndex(numChunks, rowsPerChunk);
+
+    size_t numLookups = numChunks * rowsPerChunk;
+    std::vector<uint64_t> present, missing;
+    for (size_t c = 0;  c < numChunks;  ++c) {
+        for (size_t r = 0;  r < rowsPerChunk;  ++r) {
+            present.push_back(rowName(c, r).hash());
+            missing.push_back(rowName(c + numChunks, r).hash());
+        }
+    }
+
+    for (auto & params: allParams()) {
+        Timer freezeTimer;
+        PathIndex index = freezeIndex(mutableIndex, serializer, params);
+        double freezeTime = freezeTimer.elapsed_wall();
+
+        auto timeLookups = [&] (const std::vector<uint64_t> & hashes)
+            {
+                Timer timer;
+                size_t numCandidates = 0;
+                for (auto & h: hashes)
+                    numCandidates += index.pathPossibleChunks(h).size();
+                double elapsed = timer.elapsed_wall();
+                return std::make_pair(elapsed * 1e9 / hashes.size(),
+                                      1.0 * numCandidates / hashes.size());
+            };
+
+        auto hit = timeLookups(present);
+        auto miss = timeLookups(missing);
+
+        cerr << describe(params) << ": freeze " << freezeTime << "s, "
+             << 8.0 * index.memusage() / numLookups << " bits/row, hit "
+             << hit.first << "ns (" << hit.second << " candidates), miss "
+             << miss.first << "ns (" << miss.second << " candidates)"
+             << endl;
+
+        BOOST_CHECK_GE(hit.second, 1.0);
+    }
+}
@@ -0,0 +1,122 @@
+#
+# tabular_persistence_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# A tabular dataset with a dataFileUrl is saved when it is committed, and a
+# new dataset with the same dataFileUrl loads it back.  Check that what is
+# loaded gives the same rows, columns and nulls as what was recorded.
+#
+
+import os
+import tempfile
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class TabularPersistenceTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def record(cls, name, config):
+        mldb.put('/v1/datasets/' + name, config)
+        for i in range(3000):
+            columns = [
+                ["int", i, 0],
+                ["float", i / 4.0, 0],
+                ["str", "s%d" % (i % 13), 0],
+                ["long_str", "a much longer string value %d" % i, 0],
+                ["ts", {"ts": "2016-01-01T00:00:%02dZ" % (i % 60)}, 0]
+            ]
+            # Columns with nulls: a few nulls, mostly nulls, and rows that
+            # are null in every one of them
+            if i % 10 != 3:
+                columns.append(["mostly", i % 100, 0])
+            if i % 50 == 0:
+                columns.append(["rare", "r%d" % i, 0])
+            if i % 2 == 0 and i % 7 != 0:
+                columns.append(["half", -i, 0])
+            mldb.post('/v1/datasets/%s/rows' % name, {
+                "rowName": "row%d" % i,
+                "columns": columns
+            })
+        mldb.post('/v1/datasets/%s/commit' % name)
+
+    @classmethod
+    def setUpClass(cls):
+        cls.tmpdir = tempfile.mkdtemp()
+        cls.url = "file://" + os.path.join(cls.tmpdir, "saved.mldbds")
+
+        cls.record("expected", { "type": "sparse.mutable" })
+        cls.record("saved", {
+            "type": "tabular",
+            "params": {
+                "unknownColumns": "add",
+                # Small chunks, so that there are several of them
+                "chunkByteBudget": 20000,
+                "dataFileUrl": cls.url
+            }
+        })
+
+        # A new dataset with the same URL loads what was saved
+        mldb.put('/v1/datasets/loaded', {
+            "type": "tabular",
+            "params": { "dataFileUrl": cls.url }
+        })
+
+    def check(self, query):
+        expected = mldb.query(query % "expected")
+        self.assertTableResultEquals(mldb.query(query % "saved"), expected)
+        self.assertTableResultEquals(mldb.query(query % "loaded"), expected)
+
+    def test_saved(self):
+        self.assertTrue(os.path.exists(os.path.join(self.tmpdir,
+                                                    "saved.mldbds")))
+        status = mldb.get('/v1/datasets/loaded').json()['status']
+        self.assertEqual(status['rowCount'], 3000)
+        self.assertGreater(status['chunkCount'], 1)
+
+    def test_rows(self):
+        self.check('select * from "%s" order by rowName()')
+
+    def test_row_names(self):
+        self.check('select rowName() as name from "%s" order by rowName()')
+
+        # Lookups by name use the row index that was saved
+        self.check('select * from "%s" '
+                   'where rowName() in (\'row0\', \'row1234\', \'row2999\') '
+                   'order by rowName()')
+        res = mldb.query('select * from loaded where rowName() = \'row3000\'')
+        self.assertEqual(len(res), 1)
+
+    def test_columns(self):
+        self.assertEqual(
+            sorted(mldb.get('/v1/datasets/loaded/columns').json()),
+            sorted(mldb.get('/v1/datasets/expected/columns').json()))
+
+    def test_nulls(self):
+        self.check('select count(*) as rows, count(mostly) as mostly, '
+                   'count(rare) as rare, count(half) as half from "%s"')
+        self.check('select mostly, rare, half from "%s" '
+                   'where mostly is null or half is null order by rowName()')
+
+        # Rows that are null in every nullable column come back with all
+        # of them null
+        res = mldb.query('select mostly is null as m, rare is null as r, '
+                         'half is null as h from loaded '
+                         'where rowName() = \'row3\'')
+        self.assertEqual(res[1][1:], [True, True, True])
+
+    def test_values(self):
+        self.check('select sum(int) as i, sum(float) as f, '
+                   'min(str) as s, max(long_str) as l, max(ts) as t '
+                   'from "%s"')
+        self.check('select int, str from "%s" '
+                   'where float > 700 and str = \'s5\' order by rowName()')
+
+    def test_read_only(self):
+        with self.assertRaises(ResponseException):
+            mldb.post('/v1/datasets/loaded/rows', {
+                "rowName": "new",
+                "columns": [["int", 1, 0]]
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,83 @@
+#
+# tabular_projection_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# The tabular dataset only decodes the columns that a query reads.  Check
+# that this gives the same results as a dataset that reads whole rows.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class TabularProjectionTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        for t in ["sparse.mutable", "tabular"]:
+            mldb.put('/v1/datasets/%s' % t, { "type":t })
+
+            for i in range(200):
+                columns = [["c%d" % c, i * c, 0] for c in range(40)]
+                columns.append(["b", i % 7, 0])
+                columns.append(["x.y", "y%d" % i, 0])
+                columns.append(["x.z", i % 3, 0])
+                if i % 5 == 0:
+                    columns.append(["sparse", i, 0])
+                mldb.post('/v1/datasets/%s/rows' % t, {
+                    "rowName": "row%d" % i,
+                    "columns": columns
+                })
+
+            mldb.post("/v1/datasets/%s/commit" % t)
+
+    def check(self, query):
+        expected = mldb.query(query % "sparse.mutable")
+        self.assertTableResultEquals(mldb.query(query % "tabular"),
+                                     expected)
+
+    def test_select_column_where(self):
+        self.check('select c3 from "%s" where b = 3 order by rowName()')
+
+    def test_select_star_where(self):
+        self.check('select * from "%s" where b = 3 order by rowName()')
+
+    def test_select_structured(self):
+        self.check('select x from "%s" where x.z = 1 order by rowName()')
+        self.check('select x.y from "%s" where b = 2 order by rowName()')
+
+    def test_column_count(self):
+        self.check('select columnCount() from "%s" where b = 3 '
+                   'order by rowName()')
+        self.check('select c1 from "%s" where columnCount() > 43 '
+                   'order by rowName()')
+
+    def test_sparse_column(self):
+        self.check('select sparse, c2 from "%s" where sparse > 100 '
+                   'order by rowName()')
+
+    def test_is_null(self):
+        self.check('select c2 from "%s" where sparse is null '
+                   'order by rowName()')
+        self.check('select sparse from "%s" where sparse is not null '
+                   'order by rowName()')
+        self.check('select c2 from "%s" where sparse is not null and b = 3 '
+                   'order by rowName()')
+        self.check('select c2 from "%s" where c3 is null order by rowName()')
+        self.check('select c2 from "%s" where missing is null '
+                   'order by rowName()')
+        self.check('select x from "%s" where x is not null '
+                   'order by rowName()')
+
+    def test_alias(self):
+        self.check('select t.c4 from "%s" as t where t.b = 3 '
+                   'order by rowName()')
+
+    def test_order_by_other_column(self):
+        self.check('select c5 from "%s" where b = 1 order by c7 desc, '
+                   'rowName()')
+
+    def test_group_by(self):
+        self.check('select b, sum(c6) as total from "%s" where c1 > 20 '
+                   'group by b order by b')
+
+if __name__ == '__main__':
+    mldb.run_tests()
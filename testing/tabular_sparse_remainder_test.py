@@ -0,0 +1,138 @@
+#
+# tabular_sparse_remainder_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# The tabular dataset stores rare sparse columns in a row-oriented section
+# of each chunk, and sizes its chunks from a byte budget.  Check that this
+# gives the same results as a dataset that stores everything the same way.
+#
+
+import os
+import tempfile
+import time
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class TabularSparseRemainderTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def record(cls, name, config):
+        mldb.put('/v1/datasets/' + name, config)
+        for i in range(2000):
+            columns = [["a", i, 0], ["b", i % 7, 0]]
+            # Rare columns, each in only a couple of rows
+            if i % 100 == 0:
+                columns.append(["rare%d" % (i % 300), "r%d" % i, 0])
+                columns.append(["x.rare", i, 0])
+            # Common sparse column
+            if i % 3 == 0:
+                columns.append(["common", i * 2, 0])
+            mldb.post('/v1/datasets/%s/rows' % name, {
+                "rowName": "row%d" % i,
+                "columns": columns
+            })
+        mldb.post('/v1/datasets/%s/commit' % name)
+
+    @classmethod
+    def setUpClass(cls):
+        cls.tmpdir = tempfile.mkdtemp()
+        cls.record("expected", { "type": "sparse.mutable" })
+        cls.record("remainder", {
+            "type": "tabular",
+            "params": {
+                "unknownColumns": "add",
+                "sparseRemainderFraction": 0.05,
+                "chunkByteBudget": 20000,
+                "dataFileUrl": "file://" + os.path.join(cls.tmpdir,
+                                                        "remainder.mldbds")
+            }
+        })
+
+        # Load it back from the file it was saved to
+        mldb.put('/v1/datasets/loaded', {
+            "type": "tabular",
+            "params": {
+                "dataFileUrl": "file://" + os.path.join(cls.tmpdir,
+                                                        "remainder.mldbds")
+            }
+        })
+
+    def check(self, query):
+        expected = mldb.query(query % "expected")
+        self.assertTableResultEquals(mldb.query(query % "remainder"),
+                                     expected)
+        self.assertTableResultEquals(mldb.query(query % "loaded"),
+                                     expected)
+
+    def test_select_star(self):
+        self.check('select * from "%s" order by rowName()')
+
+    def test_select_rare(self):
+        self.check('select rare0, rare100, x.rare from "%s" '
+                   'where rare100 is not null order by rowName()')
+        self.check('select a from "%s" where x.rare > 1000 '
+                   'order by rowName()')
+
+    def test_column_names(self):
+        self.assertEqual(
+            sorted(mldb.get('/v1/datasets/remainder/columns').json()),
+            sorted(mldb.get('/v1/datasets/expected/columns').json()))
+
+    def test_column_values(self):
+        self.check('select count(rare200) as c, sum(x.rare) as s, '
+                   'count(common) as cc from "%s"')
+
+    def test_many_chunks(self):
+        # The small byte budget forces many chunks
+        status = mldb.get('/v1/datasets/remainder').json()['status']
+        self.assertGreater(status['freeze']['chunksFrozen'], 10)
+
+    def wait_for_warmup(self, name):
+        for i in range(100):
+            status = mldb.get('/v1/datasets/' + name).json()['status']
+            if status['warmup']['state'] != 'running':
+                return status['warmup']
+            time.sleep(0.1)
+        self.fail('warmup of %s did not finish' % name)
+
+    def test_warmup(self):
+        warmup = mldb.post('/v1/datasets/loaded/routes/warmup', {
+            "columns": ["a", "common", "rare0"]
+        }).json()
+        self.assertIn(warmup['state'], ['running', 'finished'])
+
+        warmup = self.wait_for_warmup('loaded')
+        self.assertEqual(warmup['state'], 'finished')
+        self.assertGreater(warmup['bytesTotal'], 0)
+        self.assertEqual(warmup['bytesDone'], warmup['bytesTotal'])
+        self.check('select a, common, rare0 from "%s" order by rowName()')
+
+        # Or on load
+        mldb.put('/v1/datasets/warm', {
+            "type": "tabular",
+            "params": {
+                "dataFileUrl": "file://" + os.path.join(self.tmpdir,
+                                                        "remainder.mldbds"),
+                "warmup": True
+            }
+        })
+        self.assertEqual(self.wait_for_warmup('warm')['state'], 'finished')
+
+        # Only datasets loaded from a file can be warmed up
+        with self.assertRaises(ResponseException):
+            mldb.post('/v1/datasets/remainder/routes/warmup')
+
+    def test_bad_config(self):
+        with self.assertRaises(ResponseException):
+            mldb.put('/v1/datasets/bad', {
+                "type": "tabular",
+                "params": { "chunkByteBudget": 0 }
+            })
+        with self.assertRaises(ResponseException):
+            mldb.put('/v1/datasets/bad', {
+                "type": "tabular",
+                "params": { "sparseRemainderFraction": 2 }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
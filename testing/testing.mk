@@ -29,6 +29,9 @@ $(eval $(call test,svd_utils_test,mldb,boost))
 $(eval $(call test,mldb_reddit_test,mldb,boost))
 $(eval $(call test,cell_value_test,sql_expression,boost))
 $(eval $(call test,expression_value_test,sql_expression,boost))
+$(eval $(call test,query_spill_test,mldb_engine,boost))
+$(eval $(call test,procedure_run_scheduler_test,mldb_engine,boost))
+$(eval $(call test,bucket_test,mldb_engine,boost))
 
 # NOTE: sql_expression_test should NOT depend on the MLDB library.  If you
 # are tempted to add it, you have coupled them together and broken
@@ -276,10 +279,13 @@ $(eval $(call mldb_unit_test,MLDB-1190_segfault_sqlexpr_jseval.py))
 $(eval $(call mldb_unit_test,MLDB-1198-sum-inconsistency-test.py))
 $(eval $(call mldb_unit_test,MLDB-1242_sampled_dataset.py))
 $(eval $(call mldb_unit_test,MLDB-1266-import_json.py))
+$(eval $(call mldb_unit_test,json_import_fast_path_test.py))
 $(eval $(call mldb_unit_test,MLDB-1258_nofrom_segfault.py))
 $(eval $(call mldb_unit_test,MLDB-1212_csv_import_long_quoted_lines.py))
 $(eval $(call mldb_unit_test,MLDB-1275_melt_procedure.py))
 $(eval $(call mldb_unit_test,MLDB-1273-classifier-row_input.py))
+$(eval $(call mldb_unit_test,classifier_batch_apply_test.py))
+$(eval $(call mldb_unit_test,classifier_spill_training_data_test.py))
 $(eval $(call mldb_unit_test,MLDB-1305_rowNames_join.py))
 $(eval $(call mldb_unit_test,MLDB-1272-regression-training-failure.py))
 $(eval $(call mldb_unit_test,MLDB-1277-pooling-performance.py))
@@ -324,9 +330,12 @@ $(eval $(call python_addon,py_cell_conv_test_module,python_cell_converter_test_s
 $(eval $(call python_test,python_cell_converter_test,py_cell_conv_test_module))
 
 $(eval $(call mldb_unit_test,MLDB-1011-excel-import.js))
+$(eval $(call test,xlsx_xml_pull_parser_test,types arch,boost))
 $(eval $(call mldb_unit_test,MLDB-1121-csv-import-duplicates.py))
+$(eval $(call mldb_unit_test,import_text_column_types_test.py))
 $(eval $(call mldb_unit_test,MLDB-1098-csv-export.py))
 $(eval $(call mldb_unit_test,MLDB-1098-csv-export-advanced.py))
+$(eval $(call mldb_unit_test,csv_export_parallel_test.py))
 
 $(eval $(call mldb_unit_test,MLDB-1128-transform-utf8.js,,manual)) #manual -- requires specific local file?
 $(eval $(call mldb_unit_test,MLDB-1140-csv_reading_compression_test.py))
@@ -419,9 +428,11 @@ $(eval $(call mldb_unit_test,MLDB-1736_operator_precedence.py))
 $(eval $(call mldb_unit_test,MLDB-1734_case_statement.py))
 $(eval $(call mldb_unit_test,sign_function_test.py))
 $(eval $(call mldb_unit_test,import_text_test.py))
+$(eval $(call mldb_unit_test,import_parquet_test.py))
 $(eval $(call mldb_unit_test,alias_resolving_test.py))
 $(eval $(call mldb_unit_test,MLDB-1753_useragent_function.py,html))
 $(eval $(call test,MLDB-1742-tabular-dataset-integer-columns,mldb,boost))
+$(eval $(call test,tabular_path_index_test,mldb,boost))
 $(eval $(call mldb_unit_test,summary_stats_proc_test.py))
 $(eval $(call mldb_unit_test,MLDB-1766_dt_categorical.py))
 $(eval $(call mldb_unit_test,MLDB-1750-dist-tables.py))
@@ -479,6 +490,11 @@ $(eval $(call mldb_unit_test,MLDB-2025-st_contains.py))
 $(eval $(call mldb_unit_test,post_run_and_track_procedure_test.py))
 $(eval $(call mldb_unit_test,MLDB-2022-multiple-prediction-example.js))
 $(eval $(call mldb_unit_test,MLDB-2043_tabular_big_int.py))
+$(eval $(call mldb_unit_test,tabular_projection_test.py))
+$(eval $(call mldb_unit_test,tabular_sparse_remainder_test.py))
+$(eval $(call mldb_unit_test,tabular_memory_policy_test.py))
+$(eval $(call mldb_unit_test,tabular_append_commit_test.py))
+$(eval $(call mldb_unit_test,tabular_persistence_test.py))
 $(eval $(call mldb_unit_test,MLDB-2064_transform_proc_row_expr.py))
 $(eval $(call mldb_unit_test,MLDB-2065-transpose_rowdataset_segfaults.py))
 $(eval $(call mldb_unit_test,MLDB-2103-merge-row-dataset.py))
@@ -515,3 +531,45 @@ $(eval $(call mldb_unit_test,MLDB-2168-csv-import-skip-lines.js))
 $(eval $(call mldb_unit_test,decomposition_unit_test.js))
 $(eval $(call mldb_unit_test,MLDB-1426-mapped-import.py,,manual))
 $(eval $(call mldb_unit_test,js_module_test.js))
+$(eval $(call mldb_unit_test,query_memory_budget_test.py))
+$(eval $(call mldb_unit_test,query_cache_test.py))
+$(eval $(call mldb_unit_test,join_cache_test.py))
+$(eval $(call mldb_unit_test,query_explain_test.py))
+$(eval $(call mldb_unit_test,resource_usage_test.py))
+$(eval $(call mldb_unit_test,sql_shared_subexpression_test.py))
+$(eval $(call mldb_unit_test,where_pushdown_test.py))
+$(eval $(call mldb_unit_test,query_parallelism_test.py))
+$(eval $(call mldb_unit_test,sql_sketch_aggregators_test.py))
+$(eval $(call mldb_unit_test,sql_like_regex_fastpath_test.py))
+$(eval $(call mldb_unit_test,query_streaming_test.py))
+$(eval $(call mldb_unit_test,arrow_output_test.py))
+$(eval $(call mldb_unit_test,continuous_partial_aggregates_test.py))
+$(eval $(call mldb_unit_test,svd_randomized_test.py))
+$(eval $(call mldb_unit_test,experiment_parallel_folds_test.py))
+$(eval $(call mldb_unit_test,accuracy_streaming_test.py))
+$(eval $(call mldb_unit_test,embedding_hnsw_test.py))
+$(eval $(call mldb_unit_test,embedding_quantization_test.py))
+$(eval $(call mldb_unit_test,embedding_batch_neighbors_test.py))
+$(eval $(call mldb_unit_test,stats_table_sharded_test.py))
+$(eval $(call mldb_unit_test,feature_hasher_benchmark.py,,manual))
+$(eval $(call mldb_unit_test,tfidf_parallel_test.py))
+$(eval $(call mldb_unit_test,mapped_embedding_dataset_test.py))
+$(eval $(call mldb_unit_test,macro_benchmark.py,,manual))
+$(eval $(call mldb_unit_test,python_array_test.py))
+$(eval $(call mldb_unit_test,script_function_workers_test.py))
+$(eval $(call mldb_unit_test,transform_chunked_output_test.py))
+$(eval $(call mldb_unit_test,sqlite_pushdown_test.py))
+$(eval $(call mldb_unit_test,distributed_dataset_test.py))
+$(eval $(call mldb_unit_test,replica_dataset_test.py))
+$(eval $(call mldb_unit_test,zip_archive_index_test.py))
+$(eval $(call mldb_unit_test,list_files_parallel_test.py))
+$(eval $(call mldb_unit_test,import_text_checkpoint_test.py))
+$(eval $(call mldb_unit_test,dataset_row_stream_test.py))
+$(eval $(call mldb_unit_test,transposed_dataset_materialize_test.py))
+$(eval $(call mldb_unit_test,geo_index_test.py))
+$(eval $(call mldb_unit_test,signal_functions_test.py))
+$(eval $(call mldb_unit_test,decode_jpeg_test.py))
+$(eval $(call mldb_unit_test,sql_function_batch_apply_test.py))
+$(eval $(call mldb_unit_test,glz_sparse_training_test.py))
+$(eval $(call mldb_unit_test,function_cache_test.py))
+$(eval $(call mldb_unit_test,rowname_merge_join_test.py))
@@ -0,0 +1,73 @@
+#
+# tfidf_parallel_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that the per-thread document frequencies of tfidf.train add up to
+# the same totals as counting in order, and that the function loads the
+# saved vocabulary and scores with it.
+#
+import math
+import random
+from collections import defaultdict
+from mldb import mldb, MldbUnitTest, ResponseException
+
+NUM_DOCS = 20000
+NUM_WORDS = 5000
+
+class TfidfParallelTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        cls.dfs = defaultdict(int)
+
+        ds = mldb.create_dataset({'id' : 'docs', 'type' : 'sparse.mutable'})
+        for i in range(NUM_DOCS):
+            words = set('w%d' % random.randint(0, NUM_WORDS)
+                        for _ in range(random.randint(1, 20)))
+            for w in words:
+                cls.dfs[w] += 1
+            ds.record_row('doc%d' % i, [[w, 1, 0] for w in words])
+        ds.commit()
+
+        mldb.put('/v1/procedures/train', {
+            'type' : 'tfidf.train',
+            'params' : {
+                'trainingData' : 'select * from docs',
+                'modelFileUrl' : 'file://tmp/tfidf_parallel_test.idf',
+                'outputDataset' : 'dfs',
+                'functionName' : 'tfidf',
+                'runOnCreation' : True
+            }
+        })
+
+    def test_document_frequencies(self):
+        rows = mldb.query('select count from dfs')
+        self.assertEqual(len(rows) - 1, len(self.dfs))
+        for row in rows[1:]:
+            self.assertEqual(row[1], self.dfs[row[0]])
+
+    def test_scores_from_saved_vocabulary(self):
+        word = max(self.dfs, key=lambda w: self.dfs[w])
+        res = mldb.query(
+            "select tfidf({input: {%s: 2, unknownword: 1}}) as *" % word)
+        cols = dict(zip(res[0], res[1]))
+
+        # default is raw tf and inverseSmooth idf
+        self.assertAlmostEqual(
+            cols['output.' + word],
+            2 * math.log(1 + NUM_DOCS / (1.0 + self.dfs[word])), places=4)
+        self.assertAlmostEqual(cols['output.unknownword'],
+                               math.log(1 + NUM_DOCS), places=4)
+
+    def test_missing_model_file(self):
+        with self.assertRaises(ResponseException):
+            mldb.put('/v1/functions/missing', {
+                'type' : 'tfidf',
+                'params' : {
+                    'modelFileUrl' : 'file://tmp/tfidf_parallel_test_none.idf'
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
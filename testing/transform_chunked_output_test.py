@@ -0,0 +1,60 @@
+#
+# transform_chunked_output_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# The transform procedure writes its output in several chunks per thread
+# when there are many rows; check that none of them are lost.
+#
+from mldb import mldb, MldbUnitTest
+
+NUM_ROWS = 100000
+
+
+class TransformChunkedOutputTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'input', 'type' : 'tabular'})
+        ds.record_rows([['r%d' % i, [['x', i, 0], ['g', i % 7, 0]]]
+                        for i in range(NUM_ROWS)])
+        ds.commit()
+
+    def transform(self, query, output_type, **params):
+        params.update({
+            'inputData' : query,
+            'outputDataset' : {'id' : 'output', 'type' : output_type},
+        })
+        mldb.put('/v1/procedures/transform', {
+            'type' : 'transform',
+            'params' : params
+        })
+
+    def check_output(self, expected):
+        self.assertTableResultEquals(
+            mldb.query('SELECT count(*) AS n, sum(y) AS s FROM output'),
+            expected)
+
+    def test_select_into_each_type(self):
+        for output_type in ['tabular', 'sparse.mutable']:
+            for preserve_order in [False, True]:
+                self.transform('SELECT x * 2 AS y FROM input', output_type,
+                               preserveRowOrder=preserve_order)
+                self.check_output([['_rowName', 'n', 's'],
+                                   ['[]', NUM_ROWS, NUM_ROWS * (NUM_ROWS - 1)]])
+
+    def test_skip_empty_rows(self):
+        self.transform('SELECT CASE WHEN x % 2 = 0 THEN x END AS y '
+                       'FROM input', 'tabular', skipEmptyRows=True)
+        expected = range(0, NUM_ROWS, 2)
+        self.check_output([['_rowName', 'n', 's'],
+                           ['[]', len(expected), sum(expected)]])
+
+    def test_group_by(self):
+        self.transform('SELECT sum(x) AS y FROM input GROUP BY x % 1000',
+                       'tabular')
+        self.check_output([['_rowName', 'n', 's'],
+                           ['[]', 1000, NUM_ROWS * (NUM_ROWS - 1) // 2]])
+
+
+if __name__ == '__main__':
+    mldb.run_tests()
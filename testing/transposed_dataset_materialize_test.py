@@ -0,0 +1,83 @@
+#
+# transposed_dataset_materialize_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# The rows of a transposed dataset are read from an inverted copy of the
+# underlying dataset once they're used heavily, which is rebuilt when the
+# underlying dataset changes.
+#
+from mldb import mldb, MldbUnitTest
+
+
+class TransposedDatasetMaterializeTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(50):
+            ds.record_row('r{}'.format(i),
+                          [['c{}'.format(j), i * j, 0] for j in range(i % 5 + 1)])
+        ds.commit()
+        mldb.put('/v1/datasets/t', {
+            'type' : 'transposed',
+            'params' : {'dataset' : 'ds'}
+        })
+
+    def status(self):
+        return mldb.get('/v1/datasets/t').json()['status']
+
+    def test_query(self):
+        res = mldb.query('SELECT r3, r4, r9 FROM t ORDER BY rowName()')
+        self.assertEqual(res, [
+            ['_rowName', 'r3', 'r4', 'r9'],
+            ['c0', 0, 0, 0],
+            ['c1', 3, 4, 9],
+            ['c2', 6, 8, 18],
+            ['c3', 9, 12, 27],
+            ['c4', None, 16, 36]
+        ])
+        status = self.status()
+        self.assertTrue(status['materialized'])
+        self.assertEqual(status['materializedRows'], 5)
+        self.assertEqual(status['materializedValues'], 150)
+
+        # The same as what the transpose() function gives
+        self.assertEqual(
+            mldb.query('SELECT count(*) FROM t'),
+            mldb.query('SELECT count(*) FROM transpose(ds)'))
+        self.assertEqual(
+            mldb.query('SELECT r4, r9, r49 FROM t WHERE rowName() = \'c4\''),
+            [['_rowName', 'r4', 'r9', 'r49'], ['c4', 16, 36, 196]])
+
+    def test_rebuilt_after_change(self):
+        mldb.put('/v1/datasets/ds2', {'type' : 'sparse.mutable'})
+        mldb.post('/v1/datasets/ds2/rows',
+                  {'rowName' : 'a', 'columns' : [['x', 1, 0]]})
+        mldb.post('/v1/datasets/ds2/commit')
+        mldb.put('/v1/datasets/t2', {
+            'type' : 'transposed',
+            'params' : {'dataset' : 'ds2'}
+        })
+
+        res = mldb.query('SELECT * FROM t2')
+        self.assertEqual(res, [['_rowName', 'a'], ['x', 1]])
+        status = mldb.get('/v1/datasets/t2').json()['status']
+        self.assertTrue(status['materialized'])
+        self.assertEqual(status['numMaterializations'], 1)
+
+        mldb.post('/v1/datasets/ds2/rows',
+                  {'rowName' : 'b', 'columns' : [['x', 2, 0], ['y', 3, 0]]})
+        mldb.post('/v1/datasets/ds2/commit')
+        status = mldb.get('/v1/datasets/t2').json()['status']
+        self.assertFalse(status['materialized'])
+
+        res = mldb.query('SELECT a, b FROM t2 ORDER BY rowName()')
+        self.assertEqual(res, [['_rowName', 'a', 'b'],
+                               ['x', 1, 2],
+                               ['y', None, 3]])
+        status = mldb.get('/v1/datasets/t2').json()['status']
+        self.assertTrue(status['materialized'])
+        self.assertEqual(status['numMaterializations'], 2)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -215,6 +215,71 @@ class UnionDatasetTest(MldbUnitTest):  # noqa
         res = mldb.query("SELECT * FROM union_test_where WHERE colA='123'")
         self.assertEqual(len(res), 1)
 
+    def find_all(self, node, type):
+        result = []
+        if node['type'] == type:
+            result.append(node)
+        for child in node.get('children', []):
+            result.extend(self.find_all(child, type))
+        return result
+
+    def test_where_pushed_down(self):
+        mldb.put('/v1/datasets/union_test_pushdown', {
+            'type' : 'union',
+            'params' : {
+                'datasets' : [{'id' : 'ds3'}, {'id' : 'ds4'}, {'id' : 'ds1'}]
+            }
+        })
+
+        query = "SELECT colA FROM union_test_pushdown WHERE colA = 'A' " \
+                "ORDER BY rowName()"
+        self.assertTableResultEquals(mldb.query(query), [
+            ['_rowName', 'colA'],
+            ['0.row2', 'A'],
+            ['2.row1', 'A']
+        ])
+
+        plan = mldb.get('/v1/query', q=query, explain='true').json()
+        [where] = self.find_all(plan, 'GenerateRowsWhere')
+        self.assertIn('concatenate rows generated from 3 datasets',
+                      where['details']['algorithm'])
+
+        res = mldb.query("SELECT count(*) AS n FROM union_test_pushdown "
+                         "WHERE colA = 'AA'")
+        self.assertEqual(res[1][1], 1000)
+
+        res = mldb.query("SELECT colA FROM union_test_pushdown "
+                         "WHERE colA = 'AA' LIMIT 5 OFFSET 998")
+        self.assertEqual(len(res), 3)
+
+        # The row names of the union aren't those of the datasets, so
+        # this one is done on the union itself
+        res = mldb.query("SELECT colA FROM union_test_pushdown "
+                         "WHERE rowName() = '2.row1' AND colA = 'A'")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'colA'],
+            ['2.row1', 'A']
+        ])
+
+    def test_stream_across_datasets(self):
+        mldb.put('/v1/datasets/union_test_stream', {
+            'type' : 'union',
+            'params' : {
+                'datasets' : [{'id' : 'ds4'}, {'id' : 'ds3'}, {'id' : 'ds4'}]
+            }
+        })
+
+        res = mldb.query("SELECT count(*) AS n FROM union_test_stream")
+        self.assertEqual(res[1][1], 2000)
+
+        res = mldb.query("SELECT * FROM union_test_stream "
+                         "ORDER BY rowName() LIMIT 2 OFFSET 999")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'colA', 'colB'],
+            ['0.row999', 'AA', None],
+            ['1.row1', 'AA', 'BB']
+        ])
+
 
 if __name__ == '__main__':
     mldb.run_tests()
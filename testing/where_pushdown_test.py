@@ -0,0 +1,98 @@
+#
+# where_pushdown_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Check that WHERE clauses found from the values of a column give the same
+# rows as scanning the table.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class WherePushdownTest(MldbUnitTest):  # noqa
+
+    types = ['sparse.mutable', 'tabular', 'beh.mutable', 'embedding']
+
+    @classmethod
+    def setUpClass(cls):
+        for t in cls.types:
+            ds = mldb.create_dataset({'id' : cls.name(t), 'type' : t})
+            for i in range(100):
+                if t == 'embedding':
+                    ds.record_row('row%d' % i, [['x', i, 0], ['y', i % 4, 0]])
+                else:
+                    ds.record_row('row%d' % i,
+                                  [['x', i, 0], ['y', i % 4, 0],
+                                   ['cat', 'c%d' % (i % 4), 0],
+                                   ['name', 'name%d' % i, 0]])
+            ds.commit()
+
+    @staticmethod
+    def name(t):
+        return 'ds_' + t.replace('.', '_')
+
+    def rows(self, t, where):
+        res = mldb.query("SELECT x FROM %s WHERE %s ORDER BY rowName()"
+                         % (self.name(t), where))
+        return [r[0] for r in res[1:]]
+
+    def check(self, where, types=None):
+        for t in types or self.types:
+            # Comparing the whole clause with true stops it being recognized,
+            # so it's evaluated on each row
+            expected = self.rows(t, "(%s) = true" % where)
+            self.assertEqual(self.rows(t, where), expected,
+                             "%s on %s" % (where, t))
+        return expected
+
+    def test_ranges(self):
+        self.assertEqual(len(self.check("x BETWEEN 10 AND 20")), 11)
+        self.assertEqual(len(self.check("x > 5 AND x <= 8")), 3)
+        self.assertEqual(len(self.check("x < 3 OR x >= 97")), 6)
+        self.assertEqual(len(self.check("x BETWEEN 10 AND 20 AND y = 1")), 3)
+
+    def test_in(self):
+        strings = ['sparse.mutable', 'tabular', 'beh.mutable']
+        self.assertEqual(len(self.check("cat IN ('c1', 'c3')", strings)), 50)
+        self.assertEqual(len(self.check("x BETWEEN 10 AND 20 "
+                                        "AND cat IN ('c1', 'c3')",
+                                        strings)), 6)
+        self.assertEqual(len(self.check("x IN (1, 5, 7, 1000)")), 3)
+
+    def test_like(self):
+        strings = ['sparse.mutable', 'tabular', 'beh.mutable']
+        self.assertEqual(len(self.check("name LIKE 'name1%'", strings)), 11)
+        self.assertEqual(len(self.check("name LIKE 'name_5' AND x > 50",
+                                        strings)), 4)
+
+    def test_residual(self):
+        # Only one side can be found from a column
+        self.assertEqual(len(self.check("x IN (1, 5, 7) "
+                                        "AND rowName() != 'row5'")), 2)
+        self.assertEqual(len(self.check("x < 10 AND x % 2 = 0")), 5)
+
+    def test_unknown_column(self):
+        for t in self.types:
+            self.assertEqual(self.rows(t, "unknown BETWEEN 1 AND 2"), [])
+
+    def test_explain(self):
+        plan = mldb.get('/v1/query',
+                        q="SELECT x FROM ds_sparse_mutable "
+                          "WHERE x BETWEEN 10 AND 20",
+                        explain='true').json()
+
+        def find(node):
+            if node['type'] == 'GenerateRowsWhere':
+                return node
+            for child in node.get('children', []):
+                res = find(child)
+                if res:
+                    return res
+
+        node = find(plan)
+        self.assertTrue(node['details']['algorithm'].startswith(
+            "generate rows from the values of column 'x'"))
+        self.assertEqual(node['details']['complexity'],
+                         'BETTER_THAN_TABLESCAN')
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,233 @@
+/* xlsx_xml_pull_parser_test.cc
+   This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
+
+   Test of the streaming XML tokenizer used by the Excel importer.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/msoffice/xml_pull_parser.h"
+#include "mldb/arch/exception_handler.h"
+#include <sstream>
+
+using namespace std;
+
+using namespace MLDB;
+
+/** Return the events of the whole document, one per string: "<name>" for
+    a start element, "</name>" for an end element and the text for text.
+    Consecutive text events are joined.
+*/
+static vector<string> events(const string & xml)
+{
+    std::stringbuf buf(xml);
+    XmlPullParser parser(&buf);
+
+    vector<string> result;
+    bool lastWasText = false;
+    for (auto event = parser.next();  event != XmlPullParser::END_DOCUMENT;
+         event = parser.next()) {
+        switch (event) {
+        case XmlPullParser::START_ELEMENT:
+            result.push_back("<" + parser.name() + ">");
+            break;
+        case XmlPullParser::END_ELEMENT:
+            result.push_back("</" + parser.name() + ">");
+            break;
+        case XmlPullParser::TEXT:
+            if (lastWasText)
+                result.back() += parser.text();
+            else result.push_back(parser.text());
+            break;
+        case XmlPullParser::END_DOCUMENT:
+            break;
+        }
+        lastWasText = event == XmlPullParser::TEXT;
+    }
+    return result;
+}
+
+/// Return the text of the string item that starts the document
+static string stringItem(const string & xml)
+{
+    std::stringbuf buf(xml);
+    XmlPullParser parser(&buf);
+    BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::START_ELEMENT);
+    string result;
+    readStringItem(parser, result);
+    BOOST_CHECK_EQUAL(parser.next(), XmlPullParser::END_DOCUMENT);
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( test_entities )
+{
+    std::stringbuf buf("<a x=\"&lt;&amp;&#65;&#x42;\" y='&quot;'>"
+                       "&gt;&quot;&apos;&#233;&#x20AC;&#x1F600;</a>");
+    XmlPullParser parser(&buf);
+    BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::START_ELEMENT);
+    BOOST_REQUIRE(parser.attr("x"));
+    BOOST_CHECK_EQUAL(*parser.attr("x"), "<&AB");
+    BOOST_REQUIRE(parser.attr("y"));
+    BOOST_CHECK_EQUAL(*parser.attr("y"), "\"");
+    BOOST_CHECK(!parser.attr("z"));
+    BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::TEXT);
+    BOOST_CHECK_EQUAL(parser.text(),
+                      ">\"'\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80");
+    BOOST_CHECK_EQUAL(parser.next(), XmlPullParser::END_ELEMENT);
+    BOOST_CHECK_EQUAL(parser.next(), XmlPullParser::END_DOCUMENT);
+}
+
+BOOST_AUTO_TEST_CASE( test_cdata )
+{
+    vector<string> expected = { "<t>", "x<b>&amp;]]>y", "</t>" };
+    auto found = events("<t>x<![CDATA[<b>&amp;]]]]><![CDATA[>y]]></t>");
+    BOOST_CHECK_EQUAL_COLLECTIONS(found.begin(), found.end(),
+                                  expected.begin(), expected.end());
+
+    expected = { "<t>", "</t>" };
+    found = events("<t><![CDATA[]]></t>");
+    BOOST_CHECK_EQUAL_COLLECTIONS(found.begin(), found.end(),
+                                  expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE( test_skipped_markup )
+{
+    vector<string> expected = { "<a>", "12", "</a>" };
+    auto found = events("<?xml version=\"1.0\"?>"
+                        "<!DOCTYPE a [ <!ENTITY e \"x\"> ]>"
+                        "<a><!-- a -- comment -->1<?pi x?>2</a>");
+    BOOST_CHECK_EQUAL_COLLECTIONS(found.begin(), found.end(),
+                                  expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE( test_namespaces )
+{
+    std::stringbuf buf("<x:worksheet xmlns:x=\"urn:x\">"
+                       "<x:c r:id=\"rId1\"></x:c></x:worksheet>");
+    XmlPullParser parser(&buf);
+    BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::START_ELEMENT);
+    BOOST_CHECK_EQUAL(parser.name(), "worksheet");
+    BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::START_ELEMENT);
+    BOOST_CHECK_EQUAL(parser.name(), "c");
+    BOOST_REQUIRE(parser.attr("id"));
+    BOOST_CHECK_EQUAL(*parser.attr("id"), "rId1");
+    BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::END_ELEMENT);
+    BOOST_CHECK_EQUAL(parser.name(), "c");
+    BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::END_ELEMENT);
+    BOOST_CHECK_EQUAL(parser.name(), "worksheet");
+    BOOST_CHECK_EQUAL(parser.next(), XmlPullParser::END_DOCUMENT);
+}
+
+BOOST_AUTO_TEST_CASE( test_self_closing )
+{
+    std::stringbuf buf("<row><c r=\"A1\"/><c r=\"B1\" /></row>");
+    XmlPullParser parser(&buf);
+    BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::START_ELEMENT);
+    for (string r: { "A1", "B1" }) {
+        BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::START_ELEMENT);
+        BOOST_CHECK_EQUAL(parser.name(), "c");
+        BOOST_REQUIRE(parser.attr("r"));
+        BOOST_CHECK_EQUAL(*parser.attr("r"), r);
+        BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::END_ELEMENT);
+        BOOST_CHECK_EQUAL(parser.name(), "c");
+    }
+    BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::END_ELEMENT);
+    BOOST_CHECK_EQUAL(parser.name(), "row");
+    BOOST_CHECK_EQUAL(parser.next(), XmlPullParser::END_DOCUMENT);
+}
+
+BOOST_AUTO_TEST_CASE( test_shared_string_items )
+{
+    BOOST_CHECK_EQUAL(stringItem("<si><t>plain</t></si>"), "plain");
+    BOOST_CHECK_EQUAL(stringItem("<si/>"), "");
+    BOOST_CHECK_EQUAL(stringItem("<si><t/></si>"), "");
+
+    // Rich text runs are joined, and phonetic hints are left out
+    BOOST_CHECK_EQUAL(stringItem("<si>"
+                                 "<r><rPr><b/><sz val=\"11\"/></rPr>"
+                                 "<t>Hello</t></r>"
+                                 "<r><t xml:space=\"preserve\"> w&amp;</t></r>"
+                                 "<r><t><![CDATA[orld]]></t></r>"
+                                 "<rPh sb=\"0\" eb=\"1\"><t>ha</t></rPh>"
+                                 "<phoneticPr fontId=\"1\"/>"
+                                 "</si>"),
+                      "Hello w&orld");
+}
+
+BOOST_AUTO_TEST_CASE( test_inline_string_cell )
+{
+    std::stringbuf buf("<c r=\"A1\" t=\"inlineStr\">"
+                       "<is><r><t>inline</t></r><r><t> &lt;text&gt;</t></r></is>"
+                       "</c>");
+    XmlPullParser parser(&buf);
+    BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::START_ELEMENT);
+    BOOST_REQUIRE(parser.attr("t"));
+    BOOST_CHECK_EQUAL(*parser.attr("t"), "inlineStr");
+    BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::START_ELEMENT);
+    BOOST_CHECK_EQUAL(parser.name(), "is");
+
+    string contents;
+    readStringItem(parser, contents);
+    BOOST_CHECK_EQUAL(contents, "inline <text>");
+
+    // The item's end element has been read
+    BOOST_REQUIRE_EQUAL(parser.next(), XmlPullParser::END_ELEMENT);
+    BOOST_CHECK_EQUAL(parser.name(), "c");
+    BOOST_CHECK_EQUAL(parser.next(), XmlPullParser::END_DOCUMENT);
+}
+
+BOOST_AUTO_TEST_CASE( test_malformed )
+{
+    // Each of these needs to be rejected, without reading past the end of
+    // the input or of the parser's buffers
+    vector<string> malformed = {
+        "<",
+        "<a",
+        "<>",
+        "< a>",
+        "</a",
+        "<a/",
+        "<a b>",
+        "<a b=c>",
+        "<a b=\"c",
+        "<a b=\"c>",
+        "<a b=\"&bogus;\">",
+        "<a:>",
+        "&",
+        "&amp",
+        "&bogus;",
+        "&;",
+        "&#;",
+        "&#x;",
+        "&#xg;",
+        "&# 65;",
+        "&#-65;",
+        "&#+65;",
+        "&#0;",
+        "&#x110000;",
+        "&#xD800;",
+        "&#99999999999999999999999;",
+        "&abcdefghijklmnopqrstuvwxyz;",
+        "<!-- unterminated",
+        "<!-- unterminated -",
+        "<![CDATA[unterminated]]",
+        "<![CDAT",
+        "<?pi",
+        "<!DOCTYPE a [ <!ENTITY e \"x\">",
+    };
+
+    Set_Trace_Exceptions trace(false);
+
+    for (auto & xml: malformed) {
+        BOOST_TEST_CHECKPOINT(xml);
+        BOOST_CHECK_THROW(events(xml), AnnotatedException);
+    }
+
+    // A string item that isn't closed
+    for (string xml: { "<si><t>x", "<si><r><t>x</t>", "<is>" }) {
+        BOOST_TEST_CHECKPOINT(xml);
+        BOOST_CHECK_THROW(stringItem(xml), AnnotatedException);
+    }
+}
@@ -0,0 +1,69 @@
+#
+# zip_archive_index_test.py
+# This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+#
+# Members of zip files are read directly through the central directory,
+# rather than by reading through the archive; check that any member can be
+# read, in any order, whatever its compression.
+#
+import os
+import tarfile
+import tempfile
+import zipfile
+from mldb import mldb, MldbUnitTest, ResponseException
+
+
+def member_csv(i):
+    return 'a,b\n' + ''.join('%d,%d\n' % (i, j) for j in range(i % 7 + 1))
+
+
+class ZipArchiveIndexTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.tmp_dir = tempfile.mkdtemp(dir='build/x86_64/tmp')
+        cls.zip_path = os.path.join(cls.tmp_dir, 'members.zip')
+        with zipfile.ZipFile(cls.zip_path, 'w') as z:
+            for i in range(500):
+                method = zipfile.ZIP_DEFLATED if i % 2 else zipfile.ZIP_STORED
+                z.writestr('dir%d/m%d.csv' % (i % 5, i), member_csv(i),
+                           compress_type=method)
+
+        cls.tar_path = os.path.join(cls.tmp_dir, 'members.tar.gz')
+        csv_path = os.path.join(cls.tmp_dir, 'm3.csv')
+        with open(csv_path, 'w') as f:
+            f.write(member_csv(3))
+        with tarfile.open(cls.tar_path, 'w:gz') as t:
+            t.add(csv_path, arcname='dir3/m3.csv')
+
+    def import_member(self, archive, name, dataset):
+        mldb.post('/v1/procedures', {
+            'type' : 'import.text',
+            'params' : {
+                'dataFileUrl' : 'archive+file://' + archive + '#' + name,
+                'outputDataset' : dataset,
+                'runOnCreation' : True
+            }
+        })
+        return mldb.query('SELECT a, b FROM {} ORDER BY b'.format(dataset))
+
+    def expected(self, i):
+        return [['_rowName', 'a', 'b']] + \
+            [[str(j + 2), i, j] for j in range(i % 7 + 1)]
+
+    def test_members_in_any_order(self):
+        for i in [499, 0, 250, 1, 498, 17]:
+            name = 'dir%d/m%d.csv' % (i % 5, i)
+            res = self.import_member(self.zip_path, name, 'zip%d' % i)
+            self.assertTableResultEquals(res, self.expected(i))
+
+    def test_missing_member(self):
+        with self.assertRaises(ResponseException):
+            self.import_member(self.zip_path, 'dir0/nothere.csv', 'missing')
+
+    def test_tar_is_still_read_through(self):
+        res = self.import_member(self.tar_path, 'dir3/m3.csv', 'tar3')
+        self.assertTableResultEquals(res, self.expected(3))
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -17,6 +17,8 @@
 #include "mldb/arch/exception.h"
 #include "dtoa.h"
 #include <chrono>
+#include <charconv>
+#include <algorithm>
 #include <regex>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
@@ -87,6 +89,248 @@ expectFixedWidthInt(ParseContext & context,
 const boost::posix_time::ptime
 epoch(boost::gregorian::date(1970, 1, 1));
 
+/** Number of days between 1970-01-01 and the given day of the proleptic
+    Gregorian calendar, and back again.  These are the usual branch-free
+    civil calendar algorithms, which are much quicker than going through
+    boost::gregorian or gmtime_r().
+*/
+int64_t daysFromCivil(int year, unsigned month, unsigned day)
+{
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yearOfEra = year - era * 400;
+    unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5
+        + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100
+        + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+void civilFromDays(int64_t days, int & year, unsigned & month, unsigned & day)
+{
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned dayOfEra = days - era * 146097;
+    unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524
+                          - dayOfEra / 146096) / 365;
+    unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4
+                                     - yearOfEra / 100);
+    unsigned mp = (5 * dayOfYear + 2) / 153;
+    day = dayOfYear - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = yearOfEra + era * 400 + (month <= 2);
+}
+
+unsigned daysInMonth(int year, unsigned month)
+{
+    static const unsigned char days[12]
+        = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if (month == 2 && year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))
+        return 29;
+    return days[month - 1];
+}
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/** Pack the 8 characters of pattern into a word, in the order they are
+    loaded from memory.  If limits is true, each byte is instead what
+    needs to be added to make the high bit overflow for the characters
+    that don't match: those above 9 for the digits, marked '0' in the
+    pattern, and those above 0 for the others.
+*/
+constexpr uint64_t packPattern(const char * pattern, bool limits)
+{
+    uint64_t result = 0;
+    for (int i = 0;  i < 8;  ++i) {
+        uint64_t c = limits ? (pattern[i] == '0' ? 0x76 : 0x7f)
+            : (unsigned char)pattern[i];
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        result |= c << (8 * (7 - i));
+#else
+        result |= c << (8 * i);
+#endif
+    }
+    return result;
+}
+
+/** Check all 8 characters at p against the pattern at once.  On success,
+    byte i of values is the value of the digit at p[i] (see digitAt()).
+*/
+template<uint64_t Pattern, uint64_t Limits>
+inline bool matchPattern8(const char * p, uint64_t & values)
+{
+    uint64_t x;
+    memcpy(&x, p, 8);
+    values = x ^ Pattern;
+    const uint64_t high = 0x8080808080808080ULL;
+    return ((((values & ~high) + Limits) | values) & high) == 0;
+}
+
+inline int digitAt(uint64_t values, int i)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return (values >> (8 * (7 - i))) & 0xff;
+#else
+    return (values >> (8 * i)) & 0xff;
+#endif
+}
+
+inline int twoDigits(const char * p)
+{
+    return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+/** Parse the fixed layout that nearly all ISO 8601 date times are in,
+    YYYY-MM-DD[(T| )HH:MM:SS[.fff]][Z|(+|-)HH:MM], into seconds since the
+    epoch.  The digits are all checked at once, and the arithmetic is done
+    exactly as Iso8601Parser does it so that the result is identical.
+    Returns false for anything else, including invalid dates, to let the
+    general parser deal with it.
+*/
+bool parseIso8601Fast(const char * str, size_t len, double & result)
+{
+    constexpr uint64_t datePattern = packPattern("0000-00-", false);
+    constexpr uint64_t dateLimits = packPattern("0000-00-", true);
+    constexpr uint64_t timePatternT = packPattern("00T00:00", false);
+    constexpr uint64_t timePatternSpace = packPattern("00 00:00", false);
+    constexpr uint64_t timeLimits = packPattern("00T00:00", true);
+
+    uint64_t values;
+    if (len < 10 || len > 64
+        || !matchPattern8<datePattern, dateLimits>(str, values)
+        || !isDigit(str[8]) || !isDigit(str[9]))
+        return false;
+
+    int year = digitAt(values, 0) * 1000 + digitAt(values, 1) * 100
+        + digitAt(values, 2) * 10 + digitAt(values, 3);
+    unsigned month = digitAt(values, 5) * 10 + digitAt(values, 6);
+    unsigned day = twoDigits(str + 8);
+    if (year < 1400 || month < 1 || month > 12
+        || day < 1 || day > daysInMonth(year, month))
+        return false;
+
+    double date = daysFromCivil(year, month, day) * 86400.0;
+    if (len == 10) {
+        result = date;
+        return true;
+    }
+
+    if (len < 19)
+        return false;
+    bool matched = str[10] == ' '
+        ? matchPattern8<timePatternSpace, timeLimits>(str + 8, values)
+        : matchPattern8<timePatternT, timeLimits>(str + 8, values);
+    if (!matched || str[16] != ':' || !isDigit(str[17]) || !isDigit(str[18]))
+        return false;
+
+    int hours = digitAt(values, 3) * 10 + digitAt(values, 4);
+    int minutes = digitAt(values, 6) * 10 + digitAt(values, 7);
+    int seconds = twoDigits(str + 17);
+    if (hours > 23 || minutes > 59 || seconds > 60)
+        return false;
+
+    double time = 0.0;
+    time += hours * 3600.0;
+    time += minutes * 60.0;
+    time += seconds;
+
+    const char * p = str + 19, * end = str + len;
+    if (p != end && *p == '.') {
+        // As for Iso8601Parser, the fraction is parsed along with the
+        // seconds of the day so that it's rounded in the same way
+        const char * digits = ++p;
+        while (p != end && isDigit(*p))
+            ++p;
+        if (p == digits)
+            return false;
+        char buf[96];
+        int n = snprintf(buf, sizeof(buf), "%lld.", (long long)time);
+        memcpy(buf + n, digits, p - digits);
+        buf[n + (p - digits)] = 0;
+        time = strtod(buf, nullptr);
+    }
+
+    if (p != end && *p == 'Z') {
+        ++p;
+    }
+    else if (p != end && (*p == '+' || *p == '-')) {
+        if (end - p != 6 || !isDigit(p[1]) || !isDigit(p[2]) || p[3] != ':'
+            || !isDigit(p[4]) || !isDigit(p[5]))
+            return false;
+        int tzHours = twoDigits(p + 1), tzMinutes = twoDigits(p + 4);
+        if (tzHours > 23 || tzMinutes > 59)
+            return false;
+        int tz = tzHours * 60 + tzMinutes;
+        time += (*p == '+' ? -tz : tz) * 60.0;
+        p += 6;
+    }
+
+    if (p != end)
+        return false;
+
+    result = date + time;
+    return true;
+}
+
+/** The calendar day of the last date that was printed on this thread,
+    as YYYY-MM-DD.  Timestamps that are printed together are nearly always
+    on the same day, so this saves converting it each time.
+*/
+struct PrintedDay {
+    int64_t day = std::numeric_limits<int64_t>::min();
+    char text[10];
+};
+
+thread_local PrintedDay printedDay;
+
+inline void writeTwoDigits(char * p, unsigned val)
+{
+    p[0] = '0' + val / 10;
+    p[1] = '0' + val % 10;
+}
+
+/** Write the whole seconds t since the epoch into buf as
+    YYYY-MM-DD?HH:MM:SS, with separator between the date and the time,
+    exactly as strftime() would.  Returns false for years that don't have
+    four digits, which are left to strftime().
+*/
+bool printDateTimeFast(int64_t t, char separator, char * buf)
+{
+    int64_t days = t / 86400, secs = t % 86400;
+    if (secs < 0) {
+        secs += 86400;
+        days -= 1;
+    }
+
+    PrintedDay & cache = printedDay;
+    if (days != cache.day) {
+        int year;
+        unsigned month, day;
+        civilFromDays(days, year, month, day);
+        if (year < 1000 || year > 9999)
+            return false;
+        writeTwoDigits(cache.text, year / 100);
+        writeTwoDigits(cache.text + 2, year % 100);
+        cache.text[4] = '-';
+        writeTwoDigits(cache.text + 5, month);
+        cache.text[7] = '-';
+        writeTwoDigits(cache.text + 8, day);
+        cache.day = days;
+    }
+
+    memcpy(buf, cache.text, 10);
+    buf[10] = separator;
+    writeTwoDigits(buf + 11, secs / 3600);
+    buf[13] = ':';
+    writeTwoDigits(buf + 14, secs / 60 % 60);
+    buf[16] = ':';
+    writeTwoDigits(buf + 17, secs % 60);
+    return true;
+}
+
 }
 
 namespace MLDB {
@@ -187,6 +431,18 @@ Date
 Date::
 parseIso8601DateTime(const std::string & dateTimeStr)
 {
+    return parseIso8601DateTime(dateTimeStr.data(), dateTimeStr.size());
+}
+
+Date
+Date::
+parseIso8601DateTime(const char * str, size_t len)
+{
+    double seconds;
+    if (parseIso8601Fast(str, len, seconds))
+        return fromSecondsSinceEpoch(seconds);
+
+    std::string dateTimeStr(str, len);
     if (dateTimeStr == "NaD" || dateTimeStr == "NaN")
         return notADate();
     else if (dateTimeStr == "Inf")
@@ -202,6 +458,14 @@ parseIso8601DateTime(const std::string & dateTimeStr)
     }
 }
 
+void
+Date::
+parseIso8601DateTimes(const std::string * dates, size_t n, Date * out)
+{
+    for (size_t i = 0;  i < n;  ++i)
+        out[i] = parseIso8601DateTime(dates[i].data(), dates[i].size());
+}
+
 Date
 Date::
 notADate()
@@ -264,6 +528,10 @@ static void addFractionalSeconds(std::string & result,
     if (seconds_digits == 0)
         return;
 
+    // Whole seconds never have any digits to add
+    if (seconds_digits == -1 && full_seconds == std::trunc(full_seconds))
+        return;
+
     //cerr << "adding " << seconds_digits << " to " << result << " with "
     //     << full_seconds << " partial seconds" << endl;
 
@@ -271,11 +539,29 @@ static void addFractionalSeconds(std::string & result,
     if (seconds_digits == -1) {
         int decpt;
         int sign;
-
-        char * fractionalPtr = soa_dtoa(full_seconds, 1, -1 /* ndigits */,
-                                        &decpt, &sign, nullptr);
-        std::string fractional(fractionalPtr);
-        soa_freedtoa(fractionalPtr);
+        std::string fractional;
+
+        if (std::abs(full_seconds) < 1e15) {
+            // The shortest digits that read back as the same value are
+            // the same as dtoa() gives for the range of timestamps, and
+            // much quicker to get
+            char buf[32];
+            char * end = std::to_chars(buf, buf + sizeof(buf),
+                                       std::abs(full_seconds),
+                                       std::chars_format::scientific).ptr;
+            char * e = std::find(buf, end, 'e');
+            fractional.append(buf, 1);
+            if (e > buf + 1)
+                fractional.append(buf + 2, e);
+            std::from_chars(e + (e[1] == '+' ? 2 : 1), end, decpt);
+            decpt += 1;
+        }
+        else {
+            char * fractionalPtr = soa_dtoa(full_seconds, 1, -1 /* ndigits */,
+                                            &decpt, &sign, nullptr);
+            fractional = fractionalPtr;
+            soa_freedtoa(fractionalPtr);
+        }
 
         while (decpt < 0) {
             fractional = '0' + fractional;
@@ -316,6 +602,21 @@ static void addFractionalSeconds(std::string & result,
                              seconds_digits);
 }
 
+/** Print the date as YYYY-MM-DD?HH:MM:SS, with the given separator between
+    the date and the time, as print() would with the equivalent format.
+*/
+static std::string printDateTime(const Date & date, char separator)
+{
+    double seconds = date.secondsSinceEpoch();
+    if (seconds < 100000000000 && seconds > -1000000000000) {
+        char buf[19];
+        if (printDateTimeFast((int64_t)seconds, separator, buf))
+            return std::string(buf, buf + 19);
+    }
+    return date.print(separator == 'T' ? "%Y-%m-%dT%H:%M:%S"
+                      : "%Y-%m-%d %H:%M:%S");
+}
+
 std::string
 Date::
 print(int seconds_digits) const
@@ -373,7 +674,7 @@ printIso8601(int seconds_digits) const
         else return "-Inf";
     }
 
-    string result = print("%Y-%m-%dT%H:%M:%S");
+    string result = printDateTime(*this, 'T');
 
     if (result == "Inf" || result == "-Inf" || result == "NaD")
         return result;
@@ -384,6 +685,15 @@ printIso8601(int seconds_digits) const
     return result;
 }
 
+void
+Date::
+printIso8601(const Date * dates, size_t n, std::string * out,
+             int seconds_digits)
+{
+    for (size_t i = 0;  i < n;  ++i)
+        out[i] = dates[i].printIso8601(seconds_digits);
+}
+
 std::string
 Date::
 printClassic() const
@@ -398,7 +708,7 @@ printClassic() const
         else return "-Inf";
     }
 
-    return print("%Y-%m-%d %H:%M:%S");
+    return printDateTime(*this, ' ');
 }
 
 Date
@@ -103,6 +103,19 @@ struct Date {
     static Date parseDefaultUtc(const std::string & date);
     static Date parseIso8601DateTime(const std::string & date);
 
+    /** Parse the len characters at str as an ISO 8601 date time, as with
+        parseIso8601DateTime() but without copying them into a string.
+        The usual YYYY-MM-DDTHH:MM:SS[.fff][Z|+HH:MM] layout is parsed
+        directly, without going through the general parser.
+    */
+    static Date parseIso8601DateTime(const char * str, size_t len);
+
+    /** Parse n ISO 8601 date times, putting the result in out.  Those that
+        can't be parsed are set to notADate().
+    */
+    static void parseIso8601DateTimes(const std::string * dates, size_t n,
+                                      Date * out);
+
     // Deprecated
     static Date parseIso8601(const std::string & date);
 
@@ -124,6 +137,10 @@ struct Date {
     std::string printRfc2616() const;
     std::string printClassic() const;
 
+    /** Print n dates with printIso8601(), putting the result in out. */
+    static void printIso8601(const Date * dates, size_t n, std::string * out,
+                             int seconds_digits = -1);
+
     bool operator == (const Date & other) const
     {
         bool nad1 = std::isnan(secondsSinceEpoch_);
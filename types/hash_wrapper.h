@@ -12,6 +12,7 @@
 #include "mldb/arch/format.h"
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/arch/exception.h"
+#include "mldb/base/radix_sort_key.h"
 
 namespace MLDB {
 
@@ -108,6 +109,18 @@ std::ostream & operator << (std::ostream & stream,
     return stream << h.toString();
 }
 
+// Sorting hashes is common enough to be worth a radix sort
+
+template<typename Int, int Domain>
+struct RadixSortKey<IntWrapper<Int, Domain> >
+    : public RadixSortKey<Int> {
+};
+
+template<int Domain>
+struct RadixSortKey<HashWrapper<Domain> >
+    : public RadixSortKey<uint64_t> {
+};
+
 } // namespace MLDB
 
 namespace std {
@@ -11,6 +11,7 @@
 #include "string.h"
 #include "value_description.h"
 #include "mldb/base/parse_context.h"
+#include "mldb/arch/simd_vector.h"
 #include "mldb/ext/jsoncpp/json.h"
 #include "mldb/types/string.h"
 
@@ -96,10 +97,35 @@ void skipJsonWhitespace(ParseContext & context)
             return;
     }
 
-    while (!context.eof()
-           && (context.match_whitespace() || context.match_eol()));
+    // Skip the whitespace a buffer at a time
+    while (!context.eof()) {
+        const char * p = context.get_buffer_pos();
+        size_t avail = context.get_buffer_end() - p;
+        size_t run = SIMD::vec_json_whitespace_run(p, avail);
+        context.advance_in_buffer(run);
+        if (run < avail)
+            break;
+    }
+}
+
+namespace {
+
+/** Return the number of characters from the current position of context,
+    within its current buffer, that can be copied as they are into the
+    value of a JSON string, up to maxLength.  These are found a block at a
+    time, so that strings are copied in bulk up to the next quote, escape
+    or non-ASCII character, which are then handled one by one.
+*/
+inline size_t plainJsonStringRun(const ParseContext & context,
+                                 size_t maxLength)
+{
+    const char * p = context.get_buffer_pos();
+    size_t avail = context.get_buffer_end() - p;
+    return SIMD::vec_json_string_run(p, std::min(avail, maxLength));
 }
 
+} // file scope
+
 bool matchJsonString(ParseContext & context, std::string & str)
 {
     ParseContext::Revert_Token token(context);
@@ -111,6 +137,12 @@ bool matchJsonString(ParseContext & context, std::string & str)
 
     while (!context.match_literal('"')) {
         if (context.eof()) return false;
+        size_t run = plainJsonStringRun(context, std::string::npos);
+        if (run > 0) {
+            result.append(context.get_buffer_pos(), run);
+            context.advance_in_buffer(run);
+            continue;
+        }
         int c = *context++;
         //if (c < 0 || c >= 127)
         //    context.exception("invalid JSON string character");
@@ -212,6 +244,14 @@ ssize_t expectJsonStringAscii(ParseContext & context, char * buffer, size_t maxL
 
     // Try multiple times to make it fit
     while (!context.match_literal('"')) {
+        size_t run = plainJsonStringRun(context, bufferSize - pos);
+        if (run > 0) {
+            std::copy_n(context.get_buffer_pos(), run, buffer + pos);
+            pos += run;
+            context.advance_in_buffer(run);
+            continue;
+        }
+
         int c = *context++;
         if (c == '\\') {
             c = *context++;
@@ -262,15 +302,13 @@ std::string expectJsonStringAscii(ParseContext & context)
 
     // Try multiple times to make it fit
     while (!context.match_literal('"')) {
-
-#if 0 // attempt to do it a block at a time
-        char * bufferEnd = cbuffer + bufferSize;
-
-        int charsMatched
-            = context.match_text(buffer + pos, buffer + bufferSize,
-                                 "\"\\");
-        pos += charsMatched;
-#endif
+        size_t run = plainJsonStringRun(context, bufferSize - pos);
+        if (run > 0) {
+            std::copy_n(context.get_buffer_pos(), run, buffer + pos);
+            pos += run;
+            context.advance_in_buffer(run);
+            continue;
+        }
 
         int c = *context++;
         if (c == '\\') {
@@ -381,6 +419,14 @@ Utf8String expectJsonStringUtf8(ParseContext & context)
             bufferSize = newBufferSize;
         }
 
+        size_t run = plainJsonStringRun(context, bufferSize - 4 - pos);
+        if (run > 0) {
+            std::copy_n(context.get_buffer_pos(), run, buffer + pos);
+            pos += run;
+            context.advance_in_buffer(run);
+            continue;
+        }
+
         int c = *context;
         
         //cerr << "c = " << c << " " << (char)c << endl;
@@ -594,6 +640,35 @@ JsonNumber expectJsonNumber(ParseContext & context)
 {
     JsonNumber result;
 
+    // Fast path for the integers that fit in a long long and are entirely
+    // in the current buffer
+    {
+        const char * start = context.get_buffer_pos();
+        const char * end = context.get_buffer_end();
+        const char * p = start;
+        bool negative = p != end && *p == '-';
+        if (negative)
+            ++p;
+        const char * digits = p;
+        unsigned long long mag = 0;
+        for (;  p != end && p - digits < 18 && *p >= '0' && *p <= '9';  ++p)
+            mag = mag * 10 + (*p - '0');
+
+        if (p != digits && p != end && !isdigit(*p)
+            && *p != '.' && *p != 'e' && *p != 'E') {
+            if (negative) {
+                result.sgn = -(long long)mag;
+                result.type = JsonNumber::SIGNED_INT;
+            }
+            else {
+                result.uns = mag;
+                result.type = JsonNumber::UNSIGNED_INT;
+            }
+            context.advance_in_buffer(p - start);
+            return result;
+        }
+    }
+
     std::string number;
     number.reserve(32);
 
@@ -1347,6 +1422,14 @@ expectStringUtf8(char * buffer, size_t maxLen)
             return -1;
         }
 
+        size_t run = plainJsonStringRun(*context, maxLen - 5 - pos);
+        if (run > 0) {
+            std::copy_n(context->get_buffer_pos(), run, buffer + pos);
+            pos += run;
+            context->advance_in_buffer(run);
+            continue;
+        }
+
         int c = *(*context);
         
         //cerr << "c = " << c << " " << (char)c << endl;
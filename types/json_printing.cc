@@ -10,7 +10,6 @@
 #include "mldb/base/exc_assert.h"
 
 #include "json_printing.h"
-#include "dtoa.h"
 #include <cmath>
 #include <iostream>
 #include "mldb/ext/jsoncpp/value.h"
@@ -101,6 +100,98 @@ bool isJsonValidAscii(char c)
     return (c > 0 && c < 127);
 }
 
+void appendJsonDouble(double d, std::string & out)
+{
+    if (!std::isfinite(d)) {
+        out += '"';
+        out += std::to_string(d);
+        out += '"';
+        return;
+    }
+
+    // if exactly 0 then return 0.0
+    if (d == 0.0) {
+        out += "0.0";
+        return;
+    }
+
+    // The shortest digits that read back as d, as [-]d.ddde[+-]xx.  We
+    // then lay them out as dtoa() does.
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), d,
+                             std::chars_format::scientific);
+    const char * p = buf;
+    if (*p == '-') {
+        out += '-';
+        ++p;
+    }
+
+    char digits[20];
+    int numDigits = 0;
+    for (;  *p != 'e';  ++p) {
+        if (*p != '.')
+            digits[numDigits++] = *p;
+    }
+    ++p;
+    if (*p == '+')
+        ++p;
+    int exponent = 0;
+    std::from_chars(p, res.ptr, exponent);
+
+    int decpt = exponent + 1;
+    if (decpt > 0 && decpt <= numDigits) {
+        out.append(digits, decpt);
+        out += '.';
+        if (decpt == numDigits)
+            out += '0';
+        else out.append(digits + decpt, numDigits - decpt);
+    }
+    else if (decpt <= 0 && decpt > -6) {
+        out += "0.";
+        out.append(-decpt, '0');
+        out.append(digits, numDigits);
+    }
+    else {
+        out += digits[0];
+        if (numDigits > 1) {
+            out += '.';
+            out.append(digits + 1, numDigits - 1);
+        }
+        out += 'e';
+        appendJsonInteger(decpt - 1, out);
+    }
+}
+
+void appendJsonStringUtf8(const char * str, size_t len, std::string & out)
+{
+    out += '"';
+
+    // Copy runs of characters that don't need escaping in one go; that
+    // includes the multi-byte UTF-8 characters.
+    const char * start = str, * end = str + len;
+    for (const char * p = str;  p != end;  ++p) {
+        char escaped;
+        switch (*p) {
+        case '\t': escaped = 't';  break;
+        case '\n': escaped = 'n';  break;
+        case '\r': escaped = 'r';  break;
+        case '\b': escaped = 'b';  break;
+        case '\f': escaped = 'f';  break;
+        case '\\':
+        case '\"': escaped = *p;  break;
+        default:
+            continue;
+        }
+        out.append(start, p);
+        out += '\\';
+        out += escaped;
+        start = p + 1;
+    }
+    out.append(start, end);
+
+    out += '"';
+}
+
 std::string
 jsonEscape(const std::string & str)
 {
@@ -318,6 +409,26 @@ writeStringUtf8(const char * p, size_t len)
 }
 
 
+/*****************************************************************************/
+/* JSON PRINTING CONTEXT                                                     */
+/*****************************************************************************/
+
+std::string *
+JsonPrintingContext::
+rawOutput()
+{
+    return nullptr;
+}
+
+void
+JsonPrintingContext::
+startMemberRaw(const std::string & quotedName)
+{
+    throw MLDB::Exception("startMemberRaw() called on a context with no "
+                          "raw output");
+}
+
+
 /*****************************************************************************/
 /* STREAM JSON PRINTING CONTEXT                                              */
 /*****************************************************************************/
@@ -458,8 +569,11 @@ void
 StreamJsonPrintingContext::
 writeFloat(float f)
 {
-    if (std::isfinite(f))
-        stream << MLDB::dtoa(f);
+    if (std::isfinite(f)) {
+        std::string str;
+        appendJsonDouble(f, str);
+        stream << str;
+    }
     else stream << "\"" << f << "\"";
 }
 
@@ -467,8 +581,11 @@ void
 StreamJsonPrintingContext::
 writeDouble(double d)
 {
-    if (std::isfinite(d))
-        stream << MLDB::dtoa(d);
+    if (std::isfinite(d)) {
+        std::string str;
+        appendJsonDouble(d, str);
+        stream << str;
+    }
     else stream << "\"" << d << "\"";
 }
 
@@ -550,6 +667,11 @@ void
 StringJsonPrintingContext::
 writeStringUtf8(const Utf8String & s)
 {
+    if (writeUtf8) {
+        appendJsonStringUtf8(s.rawData(), s.rawLength(), str);
+        return;
+    }
+
     write('"');
 
     for (auto it = s.begin(), end = s.end();  it != end;  ++it) {
@@ -716,80 +838,56 @@ void
 StringJsonPrintingContext::
 writeInt(int i)
 {
-    char buffer[128];
-    int chars = sprintf(buffer, "%i", i);
-    write(buffer, chars);
+    appendJsonInteger(i, str);
 }
 
 void
 StringJsonPrintingContext::
 writeUnsignedInt(unsigned int i)
 {
-    char buffer[128];
-    int chars = sprintf(buffer, "%u", i);
-    write(buffer, chars);
+    appendJsonInteger(i, str);
 }
 
 void
 StringJsonPrintingContext::
 writeLong(long int i)
 {
-    char buffer[128];
-    int chars = sprintf(buffer, "%li", i);
-    write(buffer, chars);
+    appendJsonInteger(i, str);
 }
 
 void
 StringJsonPrintingContext::
 writeUnsignedLong(unsigned long int i)
 {
-    char buffer[128];
-    int chars = sprintf(buffer, "%lu", i);
-    write(buffer, chars);
+    appendJsonInteger(i, str);
 }
 
 void
 StringJsonPrintingContext::
 writeLongLong(long long int i)
 {
-    char buffer[128];
-    int chars = sprintf(buffer, "%lli", i);
-    write(buffer, chars);
+    appendJsonInteger(i, str);
 }
 
 void
 StringJsonPrintingContext::
 writeUnsignedLongLong(unsigned long long int i)
 {
-    char buffer[128];
-    int chars = sprintf(buffer, "%llu", i);
-    write(buffer, chars);
+    appendJsonInteger(i, str);
 }
 
 void
 StringJsonPrintingContext::
 writeFloat(float f)
 {
-    if (std::isfinite(f))
-        str += MLDB::dtoa(f);
-    else {
-        write('"');
-        write(std::to_string(f));
-        write('"');
-    }
+    appendJsonDouble(f, str);
 }
 
 void
 StringJsonPrintingContext::
 writeDouble(double d)
 {
-    if (std::isfinite(d))
-        str += MLDB::dtoa(d);
-    else {
-        write('"');
-        write(std::to_string(d));
-        write('"');
-    }
+    appendJsonDouble(d, str);
 }
 
 void
@@ -824,6 +922,24 @@ writeBool(bool b)
     write(b ? "true": "false");
 }
 
+std::string *
+StringJsonPrintingContext::
+rawOutput()
+{
+    return writeUtf8 ? &str : nullptr;
+}
+
+void
+StringJsonPrintingContext::
+startMemberRaw(const std::string & quotedName)
+{
+    ExcAssert(path.back().isObject);
+    ++path.back().memberNum;
+    if (path.back().memberNum != 0)
+        write(',');
+    write(quotedName);
+}
+
 
 /*****************************************************************************/
 /* UTF8 STRING JSON PRINTING CONTEXT                                         */
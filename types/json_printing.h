@@ -12,6 +12,7 @@
 #include <string>
 #include <ostream>
 #include <vector>
+#include <charconv>
 
 namespace Json {
 struct Value;
@@ -29,6 +30,28 @@ void jsonEscape(const std::string & str, std::string & out);
 
 bool isJsonValidAscii(char c);
 
+/** Append the JSON representation of the integer i to out. */
+template<typename Int>
+void appendJsonInteger(Int i, std::string & out)
+{
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), i);
+    out.append(buf, res.ptr);
+}
+
+/** Append the JSON representation of d to out, as MLDB::dtoa() would but
+    without the allocations: with as many digits as are needed for it to be
+    read back as the same value, and no more.  Values that aren't finite
+    are written as a string.
+*/
+void appendJsonDouble(double d, std::string & out);
+
+/** Append the quoted JSON representation of the given UTF-8 string to out.
+    UTF-8 characters are written as they are, and only the characters that
+    JSON requires to be are escaped.
+*/
+void appendJsonStringUtf8(const char * str, size_t len, std::string & out);
+
 /*****************************************************************************/
 /* JSON PRINTING CONTEXT                                                     */
 /*****************************************************************************/
@@ -65,6 +88,19 @@ struct JsonPrintingContext {
 
     virtual void writeJson(const Json::Value & val) = 0;
     virtual void skip() = 0;
+
+    /** Return the string that the JSON is being written to, if values can
+        be appended to it directly with the append*() functions above, or
+        null otherwise.  Structure descriptions use this to print the
+        fields of simple types without going through their descriptions.
+        If it returns non-null, startMemberRaw() must be implemented too.
+    */
+    virtual std::string * rawOutput();
+
+    /** Start a member whose name, quoted and followed by a colon, is
+        already in JSON.  Only called if rawOutput() isn't null.
+    */
+    virtual void startMemberRaw(const std::string & quotedName);
 };
 
 
@@ -208,6 +244,10 @@ struct StringJsonPrintingContext
 
     virtual void writeBool(bool b);
 
+    /// Null unless writeUtf8 is set, as appendJsonStringUtf8() writes UTF-8
+    virtual std::string * rawOutput();
+    virtual void startMemberRaw(const std::string & quotedName);
+
 protected:
     void write(char c);
     void write(char c1, char c2);
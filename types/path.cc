@@ -958,7 +958,7 @@ extract()
 
 Path::Path(PathElement && path)
     : length_(1), digits_(path.digits_),
-      ofsBits_(0)
+      ofsBits_(0), oldHash_(0)
 {
     if (path.null()) {
         length_ = 0;
@@ -980,7 +980,7 @@ Path::Path(PathElement && path)
 Path::Path(const PathElement & path)
     : bytes_(path.storage_),
       length_(1), digits_(path.digits_),
-      ofsBits_(0)
+      ofsBits_(0), oldHash_(0)
 {
     if (path.null()) {
         length_ = 0;
@@ -1305,7 +1305,7 @@ replaceWildcard(const Path & wildcard, const Path & with) const
 
 uint64_t
 Path::
-oldHash() const
+calcOldHash() const
 {
     uint64_t result = 0;
     if (empty())
@@ -1314,6 +1314,7 @@ oldHash() const
     for (size_t i = 1;  i < size();  ++i) {
         result = Hash128to64({result, oldHashElement(i)});
     }
+    setCachedOldHash(result);
     return result;
 }
 
@@ -1403,6 +1404,13 @@ int
 Path::
 compare(const Path & other) const
 {
+    // Most paths have a single element, which is all of the bytes
+    if (length_ == 1 && other.length_ == 1) {
+        return compareElements(bytes_.data(), bytes_.size(),
+                               other.bytes_.data(), other.bytes_.size(),
+                               digits_ & 3, other.digits_ & 3);
+    }
+
     for (size_t i = 0; i < length_ && i < other.length_; ++i) {
         int cmp = compareElement(i, other, i);
         if (cmp)
@@ -1422,6 +1430,11 @@ operator == (const Path & other) const
     if (digits_ != other.digits_)
         return false;
 
+    // If both hashes are known, they tell us most of the time
+    uint64_t h1 = cachedOldHash(), h2 = other.cachedOldHash();
+    if (h1 && h2 && h1 != h2)
+        return false;
+
     // Short circuit (currently offset(0) is always 0, so always taken).
     if (PATH_OFFSET_ZERO_IS_ALWAYS_ZERO
         || (offset(0) == 0 && other.offset(0) == 0)) {
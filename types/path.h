@@ -356,7 +356,7 @@ private:
 
 struct Path {
     Path()
-        : length_(0), digits_(0), ofsPtr_(nullptr)
+        : length_(0), digits_(0), ofsPtr_(nullptr), oldHash_(0)
     {
     }
 
@@ -386,7 +386,8 @@ struct Path {
         : bytes_(other.bytes_),
           length_(other.length_),
           digits_(other.digits_),
-          ofsBits_(other.ofsBits_)
+          ofsBits_(other.ofsBits_),
+          oldHash_(other.cachedOldHash())
     {
         if (MLDB_UNLIKELY(other.externalOfs())) {
             ofsPtr_ = new uint32_t[length_ + 1];
@@ -410,6 +411,9 @@ struct Path {
         swap(ofsBits_, other.ofsBits_);
         swap(length_, other.length_);
         swap(digits_, other.digits_);
+        uint64_t otherHash = other.cachedOldHash();
+        other.setCachedOldHash(cachedOldHash());
+        setCachedOldHash(otherHash);
     }
 
     Path & operator = (Path && other) noexcept
@@ -587,8 +591,15 @@ struct Path {
     }
 
     /// Return the Id-compatible (old) hash.  Slower but compatible with
-    /// legacy binaries.
-    uint64_t oldHash() const;
+    /// legacy binaries.  It's calculated the first time it's asked for,
+    /// and then kept with the path.
+    uint64_t oldHash() const
+    {
+        uint64_t result = cachedOldHash();
+        if (MLDB_UNLIKELY(result == 0))
+            result = calcOldHash();
+        return result;
+    }
 
     /// Return the non-Id compatible (new) hash.  Faster but not compatible
     /// with legacy hashes.
@@ -667,6 +678,23 @@ private:
     uint64_t oldHashElement(size_t el) const;
     uint64_t newHashElement(size_t el) const;
 
+    /// Calculate the old hash, and keep it for next time
+    uint64_t calcOldHash() const;
+
+    /// The paths are immutable, so the hash can be kept once calculated.
+    /// It may be calculated by several threads at once, which will all
+    /// store the same value, so only the accesses themselves need to be
+    /// atomic.
+    uint64_t cachedOldHash() const
+    {
+        return __atomic_load_n(&oldHash_, __ATOMIC_RELAXED);
+    }
+
+    void setCachedOldHash(uint64_t hash) const
+    {
+        __atomic_store_n(&oldHash_, hash, __ATOMIC_RELAXED);
+    }
+
     bool externalOfs() const
     {
         return length_ >= 8 || bytes_.size() >= 256;
@@ -711,8 +739,10 @@ private:
     static std::pair<Path, bool>
     parseImpl(const char * str, size_t len, bool exceptions);
 
-    /// Encoded version of the string, not including separators
-    InternedString<46, char> bytes_;
+    /// Encoded version of the string, not including separators.  Up to
+    /// 38 bytes are stored inline, which leaves room for the cached hash
+    /// while keeping the path to 64 bytes.
+    InternedString<38, char> bytes_;
 
     /// Number of elements in the path
     uint32_t length_;
@@ -732,6 +762,9 @@ private:
         uint32_t * ofsPtr_;
         uint64_t ofsBits_;
     };
+
+    /// Cached value of oldHash(), or zero if it's not yet known
+    mutable uint64_t oldHash_;
 };
 
 std::ostream & operator << (std::ostream & stream, const Path & id);
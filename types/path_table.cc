@@ -0,0 +1,233 @@
+/** path_table.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Table of interned paths.
+*/
+
+#include "mldb/types/path_table.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/exception.h"
+#include <atomic>
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PATH TABLE                                                                */
+/*****************************************************************************/
+
+struct PathTable::Itl {
+    struct Entry {
+        Path path;
+        uint64_t hash;
+        uint32_t next;  ///< Next id with the same hash, or NONE
+    };
+
+    static constexpr uint32_t NONE = -1;
+
+    // Entries are kept in chunks that double in size, so that they never
+    // move once added and can be read without a lock.  Chunk k holds the
+    // ids from 2^(k + FIRST_CHUNK_BITS) - 2^FIRST_CHUNK_BITS onwards.
+    static constexpr int FIRST_CHUNK_BITS = 10;
+    static constexpr int NUM_CHUNKS = 32 - FIRST_CHUNK_BITS;
+
+    std::atomic<Entry *> chunks[NUM_CHUNKS];
+
+    std::mutex mutex;
+    std::atomic<uint32_t> numEntries;
+
+    /// First id for each hash; the others are chained with next
+    std::unordered_map<uint64_t, uint32_t> byHash;
+
+    Itl()
+        : numEntries(0)
+    {
+        for (auto & c: chunks)
+            c.store(nullptr);
+    }
+
+    ~Itl()
+    {
+        for (int k = 0;  k < NUM_CHUNKS;  ++k)
+            delete[] chunks[k].load();
+    }
+
+    static void locate(uint32_t id, int & chunk, size_t & offset)
+    {
+        uint64_t j = (uint64_t)id + (1 << FIRST_CHUNK_BITS);
+        int bits = 63 - __builtin_clzll(j);
+        chunk = bits - FIRST_CHUNK_BITS;
+        offset = j - (1ULL << bits);
+    }
+
+    const Entry & entry(uint32_t id) const
+    {
+        ExcAssertLess(id, numEntries.load(std::memory_order_acquire));
+        int chunk;
+        size_t offset;
+        locate(id, chunk, offset);
+        return chunks[chunk].load(std::memory_order_acquire)[offset];
+    }
+
+    /// Find the id with that path and hash, or NONE.  Mutex must be held.
+    uint32_t findLocked(const Path & path, uint64_t hash) const
+    {
+        auto it = byHash.find(hash);
+        if (it == byHash.end())
+            return NONE;
+        for (uint32_t id = it->second;  id != NONE;  id = entry(id).next) {
+            if (entry(id).path == path)
+                return id;
+        }
+        return NONE;
+    }
+    
+    uint32_t insertLocked(const Path & path, uint64_t hash)
+    {
+        uint32_t id = numEntries.load(std::memory_order_relaxed);
+        if (id == (uint32_t)((1ULL << 32) - (1 << FIRST_CHUNK_BITS)))
+            throw MLDB::Exception("PathTable is full");
+
+        int chunk;
+        size_t offset;
+        locate(id, chunk, offset);
+        Entry * entries = chunks[chunk].load(std::memory_order_relaxed);
+        if (!entries) {
+            entries = new Entry[1ULL << (chunk + FIRST_CHUNK_BITS)];
+            chunks[chunk].store(entries, std::memory_order_release);
+        }
+
+        Entry & e = entries[offset];
+        e.path = path;
+        e.hash = hash;
+        e.next = NONE;
+
+        auto res = byHash.insert({hash, id});
+        if (!res.second) {
+            // Different path with the same hash; chain it from the last one
+            uint32_t last = res.first->second;
+            while (entry(last).next != NONE)
+                last = entry(last).next;
+            const_cast<Entry &>(entry(last)).next = id;
+        }
+
+        // Publish
+        numEntries.store(id + 1, std::memory_order_release);
+        return id;
+    }
+};
+
+PathTable::
+PathTable()
+    : itl(new Itl())
+{
+}
+
+PathTable::
+~PathTable()
+{
+}
+
+uint32_t
+PathTable::
+intern(const Path & path)
+{
+    uint64_t hash = path.hash();
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    uint32_t result = itl->findLocked(path, hash);
+    if (result != Itl::NONE)
+        return result;
+    return itl->insertLocked(path, hash);
+}
+
+bool
+PathTable::
+find(const Path & path, uint32_t & id) const
+{
+    uint64_t hash = path.hash();
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    id = itl->findLocked(path, hash);
+    return id != Itl::NONE;
+}
+
+const Path &
+PathTable::
+path(uint32_t id) const
+{
+    return itl->entry(id).path;
+}
+
+uint64_t
+PathTable::
+hash(uint32_t id) const
+{
+    return itl->entry(id).hash;
+}
+
+size_t
+PathTable::
+size() const
+{
+    return itl->numEntries.load(std::memory_order_acquire);
+}
+
+PathTable &
+PathTable::
+columns()
+{
+    // Never destroyed, so that it can be used from static destructors
+    static PathTable * result = new PathTable();
+    return *result;
+}
+
+
+/*****************************************************************************/
+/* PATH POSITION INDEX                                                       */
+/*****************************************************************************/
+
+PathPositionIndex::
+PathPositionIndex(PathTable & table)
+    : table(&table)
+{
+}
+
+bool
+PathPositionIndex::
+add(const Path & path)
+{
+    uint32_t id = table->intern(path);
+    uint64_t hash = table->hash(id);
+
+    auto range = byHash.equal_range(hash);
+    for (auto it = range.first;  it != range.second;  ++it) {
+        if (ids[it->second] == id)
+            return false;
+    }
+
+    byHash.emplace(hash, ids.size());
+    ids.push_back(id);
+    return true;
+}
+
+int
+PathPositionIndex::
+find(const Path & path, int expected) const
+{
+    if (expected >= 0 && (size_t)expected < ids.size()
+        && table->path(ids[expected]) == path)
+        return expected;
+
+    auto range = byHash.equal_range(path.hash());
+    for (auto it = range.first;  it != range.second;  ++it) {
+        if (table->path(ids[it->second]) == path)
+            return it->second;
+    }
+    return -1;
+}
+
+} // namespace MLDB
@@ -0,0 +1,101 @@
+/** path_table.h                                                  -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Table of interned paths, to identify a path by a small integer.
+*/
+
+#pragma once
+
+#include "mldb/types/path.h"
+#include <memory>
+#include <unordered_map>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PATH TABLE                                                                */
+/*****************************************************************************/
+
+/** Table that interns paths, giving each distinct path a 32 bit id.  The
+    hash of each path is computed once, when it's added, and paths are
+    never removed, so an id can be used in place of its path for as long
+    as the table exists.
+
+    Adding a path takes a lock, but looking up a path or its hash by id
+    doesn't.
+*/
+struct PathTable {
+    PathTable();
+    ~PathTable();
+
+    PathTable(const PathTable &) = delete;
+    void operator = (const PathTable &) = delete;
+
+    /// Return the id of the path, adding it if it's not already there
+    uint32_t intern(const Path & path);
+
+    /// Find the id of the path.  Returns false if it was never added.
+    bool find(const Path & path, uint32_t & id) const;
+
+    /// Return the path with the given id
+    const Path & path(uint32_t id) const;
+
+    /// Return the hash of the path with the given id; this is the same as
+    /// path(id).hash().
+    uint64_t hash(uint32_t id) const;
+
+    /// Number of distinct paths in the table
+    size_t size() const;
+
+    /// Table shared by the whole process for the names of columns
+    static PathTable & columns();
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+
+/*****************************************************************************/
+/* PATH POSITION INDEX                                                       */
+/*****************************************************************************/
+
+/** Index of a list of distinct paths (typically the columns of a dataset),
+    that gives the position of each one.
+
+    The paths are interned in a PathTable so that their hashes are only
+    calculated once.  Lookups first check the position where the path is
+    expected, which is usually right when the rows being looked up have
+    their columns in the same order as the index; in that case the path
+    doesn't need to be hashed at all.
+*/
+struct PathPositionIndex {
+    PathPositionIndex(PathTable & table = PathTable::columns());
+
+    /// Add the path at the next position.  Returns false and does nothing
+    /// if it's already there.
+    bool add(const Path & path);
+
+    /** Return the position of the path, or -1 if it's not in the index.
+        If expected is a valid position, it's checked first.
+    */
+    int find(const Path & path, int expected = -1) const;
+
+    /// Number of paths in the index
+    size_t size() const { return ids.size(); }
+
+    /// Return the path at the given position
+    const Path & operator [] (size_t i) const { return table->path(ids[i]); }
+
+    /// Return the id in the path table of the path at the given position
+    uint32_t id(size_t i) const { return ids[i]; }
+
+private:
+    PathTable * table;
+    std::vector<uint32_t> ids;
+    std::unordered_multimap<uint64_t, int> byHash;
+};
+
+} // namespace MLDB
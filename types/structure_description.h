@@ -16,6 +16,181 @@
 namespace MLDB {
 
 
+/*****************************************************************************/
+/* JSON RAW FIELD                                                            */
+/*****************************************************************************/
+
+/** Prints, parses and tells if a value of type V is the default exactly
+    like its default value description does, but with functions that are
+    known at compile time.  Structure descriptions use it for their fields
+    of these simple types, so that printing one of them to a context with
+    a rawOutput() is a direct call rather than several virtual ones.
+*/
+template<typename V>
+struct JsonRawField {
+    static constexpr bool enabled = false;
+};
+
+template<typename V, typename Printed, Printed (JsonParsingContext::* expect)()>
+struct JsonRawIntegerField {
+    static constexpr bool enabled = true;
+
+    static void print(const void * val, std::string & out)
+    {
+        appendJsonInteger((Printed)*(const V *)val, out);
+    }
+
+    static void parse(void * val, JsonParsingContext & context)
+    {
+        *(V *)val = (context.*expect)();
+    }
+
+    static bool isDefault(const void * val)
+    {
+        return false;
+    }
+};
+
+// Shorts and unsigned ints are printed and parsed as ints by their
+// descriptions
+template<>
+struct JsonRawField<signed short int>
+    : JsonRawIntegerField<signed short int, int, &JsonParsingContext::expectInt> {
+};
+
+template<>
+struct JsonRawField<unsigned short int>
+    : JsonRawIntegerField<unsigned short int, int, &JsonParsingContext::expectInt> {
+};
+
+template<>
+struct JsonRawField<signed int>
+    : JsonRawIntegerField<signed int, int, &JsonParsingContext::expectInt> {
+};
+
+template<>
+struct JsonRawField<unsigned int>
+    : JsonRawIntegerField<unsigned int, int, &JsonParsingContext::expectInt> {
+};
+
+template<>
+struct JsonRawField<signed long>
+    : JsonRawIntegerField<signed long, long,
+                          &JsonParsingContext::expectLong> {
+};
+
+template<>
+struct JsonRawField<unsigned long>
+    : JsonRawIntegerField<unsigned long, unsigned long,
+                          &JsonParsingContext::expectUnsignedLong> {
+};
+
+template<>
+struct JsonRawField<signed long long>
+    : JsonRawIntegerField<signed long long, long long,
+                          &JsonParsingContext::expectLongLong> {
+};
+
+template<>
+struct JsonRawField<unsigned long long>
+    : JsonRawIntegerField<unsigned long long, unsigned long long,
+                          &JsonParsingContext::expectUnsignedLongLong> {
+};
+
+template<typename V, V (JsonParsingContext::* expect)()>
+struct JsonRawFloatField {
+    static constexpr bool enabled = true;
+
+    static void print(const void * val, std::string & out)
+    {
+        appendJsonDouble(*(const V *)val, out);
+    }
+
+    static void parse(void * val, JsonParsingContext & context)
+    {
+        *(V *)val = (context.*expect)();
+    }
+
+    static bool isDefault(const void * val)
+    {
+        return false;
+    }
+};
+
+template<>
+struct JsonRawField<float>
+    : JsonRawFloatField<float, &JsonParsingContext::expectFloat> {
+};
+
+template<>
+struct JsonRawField<double>
+    : JsonRawFloatField<double, &JsonParsingContext::expectDouble> {
+};
+
+template<>
+struct JsonRawField<bool> {
+    static constexpr bool enabled = true;
+
+    static void print(const void * val, std::string & out)
+    {
+        out += *(const bool *)val ? "true" : "false";
+    }
+
+    static void parse(void * val, JsonParsingContext & context)
+    {
+        *(bool *)val = context.expectBool();
+    }
+
+    static bool isDefault(const void * val)
+    {
+        return false;
+    }
+};
+
+template<>
+struct JsonRawField<std::string> {
+    static constexpr bool enabled = true;
+
+    static void print(const void * val, std::string & out)
+    {
+        out += '"';
+        jsonEscape(*(const std::string *)val, out);
+        out += '"';
+    }
+
+    static void parse(void * val, JsonParsingContext & context)
+    {
+        *(std::string *)val = context.expectStringAscii();
+    }
+
+    static bool isDefault(const void * val)
+    {
+        return ((const std::string *)val)->empty();
+    }
+};
+
+template<>
+struct JsonRawField<Utf8String> {
+    static constexpr bool enabled = true;
+
+    static void print(const void * val, std::string & out)
+    {
+        const Utf8String & str = *(const Utf8String *)val;
+        appendJsonStringUtf8(str.rawData(), str.rawLength(), out);
+    }
+
+    static void parse(void * val, JsonParsingContext & context)
+    {
+        *(Utf8String *)val = context.expectStringUtf8();
+    }
+
+    static bool isDefault(const void * val)
+    {
+        return ((const Utf8String *)val)->empty();
+    }
+};
+
+
 /*****************************************************************************/
 /* STRUCTURE DESCRIPTION BASE                                                */
 /*****************************************************************************/
@@ -97,6 +272,38 @@ struct StructureDescriptionBase {
 
     std::vector<Fields::const_iterator> orderedFields;
 
+    /** How to handle a field without going through its description, when
+        it's of one of the types of JsonRawField and uses their default
+        description.  The functions are null for the other fields.
+    */
+    struct RawField {
+        void (*print)(const void *, std::string &) = nullptr;
+        void (*parse)(void *, JsonParsingContext &) = nullptr;
+        /// Null if the description must be asked, eg for a default value
+        bool (*isDefault)(const void *) = nullptr;
+        std::string quotedName;   ///< "name": ready to be written out
+    };
+
+    /// One per entry in orderedFields
+    std::vector<RawField> rawFields;
+
+    /** Set up raw to handle a field of type V that uses the default
+        description of V, if V is one of the types of JsonRawField.
+    */
+    template<typename V>
+    static void setRawFunctions(RawField & raw, bool hasDefaultValue)
+    {
+        if constexpr (JsonRawField<V>::enabled) {
+            raw.print = &JsonRawField<V>::print;
+            raw.parse = &JsonRawField<V>::parse;
+            if (!hasDefaultValue)
+                raw.isDefault = &JsonRawField<V>::isDefault;
+        }
+    }
+
+    /// Add raw for the field that was just added to orderedFields
+    void addRawField(RawField raw);
+
     struct Exception: public MLDB::Exception {
         Exception(JsonParsingContext & context,
                   const std::string & message);
@@ -179,6 +386,8 @@ struct StructureDescription
                   std::string comment)
     {
         addFieldDesc(name, field, comment, getDefaultDescriptionSharedT<V>());
+        // As it's the default description, it can be bypassed
+        setRawFunctions<V>(rawFields.back(), false /* hasDefaultValue */);
     }
 
     /** Add a field, but override the default value description to use.
@@ -213,6 +422,7 @@ struct StructureDescription
         fd.width = sizeof(V);
         fd.fieldNum = fields.size() - 1;
         orderedFields.push_back(it);
+        addRawField(RawField());
         //using namespace std;
         //cerr << "offset = " << fd.offset << endl;
     }
@@ -248,6 +458,11 @@ struct StructureDescription
         fd.width = sizeof(V);
         fd.fieldNum = fields.size() - 1;
         orderedFields.push_back(it);
+
+        RawField raw;
+        if (typeid(*baseDesc) == typeid(*getDefaultDescriptionSharedT<V>()))
+            setRawFunctions<V>(raw, true /* hasDefaultValue */);
+        addRawField(std::move(raw));
     }
 
     /** Add a description with an automatic default value derived
@@ -408,7 +623,8 @@ addParent(ValueDescriptionT<V> * description_)
 
     ExcAssert(!desc2->orderedFields.empty());
 
-    for (auto & oit: description->orderedFields) {
+    for (size_t i = 0;  i < description->orderedFields.size();  ++i) {
+        auto & oit = description->orderedFields[i];
         FieldDescription & ofd = const_cast<FieldDescription &>(oit->second);
         const std::string & name = ofd.fieldName;
 
@@ -425,6 +641,7 @@ addParent(ValueDescriptionT<V> * description_)
         fd.width = ofd.width;
         fd.fieldNum = fields.size() - 1;
         orderedFields.push_back(it);
+        addRawField(description->rawFields.at(i));
     }
 }
 
@@ -13,6 +13,7 @@
 #include "mldb/arch/format.h"
 #include "mldb/base/parse_context.h"
 #include <climits>
+#include <random>
 
 using namespace std;
 using namespace MLDB;
@@ -643,3 +644,96 @@ BOOST_AUTO_TEST_CASE( test_NaD_sorting )
     BOOST_CHECK_LT(d1, d2);
     BOOST_CHECK_GE(d2, d1);
 }
+
+BOOST_AUTO_TEST_CASE( test_iso8601_fast_path_same_as_parser )
+{
+    // The usual layouts are parsed without the general parser; make sure
+    // the result is identical to what it would have given
+    auto parseGeneral = [] (const std::string & str)
+        {
+            Date result;
+            Iso8601Parser parser(str);
+            if (!parser.matchDateTime(result))
+                return Date::notADate();
+            return result;
+        };
+
+    std::mt19937 rng(1);
+    for (int i = 0;  i < 20000;  ++i) {
+        int year = 1400 + rng() % 8600;
+        int month = 1 + rng() % 12;
+        int day = 1 + rng() % 28;
+        std::string str = MLDB::format("%04d-%02d-%02d", year, month, day);
+        if (i % 5) {
+            str += MLDB::format("%c%02d:%02d:%02d", i % 2 ? 'T' : ' ',
+                                (int)(rng() % 24), (int)(rng() % 60),
+                                (int)(rng() % 61));
+            if (i % 3 == 0)
+                str += "." + std::to_string(rng() % 1000000);
+            if (i % 7 == 0)
+                str += "Z";
+            else if (i % 7 == 1)
+                str += MLDB::format("%c%02d:%02d", i % 2 ? '+' : '-',
+                                    (int)(rng() % 24), (int)(rng() % 60));
+        }
+        Date fast = Date::parseIso8601DateTime(str);
+        BOOST_REQUIRE_MESSAGE(fast.secondsSinceEpoch()
+                              == parseGeneral(str).secondsSinceEpoch(), str);
+    }
+
+    // Things that aren't in exactly that layout still go to the parser
+    for (std::string str: { "2013-02-29", "2012-02-29T00:00:00",
+                "2013-04-01T24:00:00", "2013-04-01T09:08:07+0130",
+                "2013-04-01T09:08:07.", "20130401T090807", "2013-04-01T09",
+                "2013-04-01X09:08:07", "2013-04-01T09:08:07Zjunk" }) {
+        Date fast, general;
+        try {
+            MLDB_TRACE_EXCEPTIONS(false);
+            fast = Date::parseIso8601DateTime(str);
+        } catch (...) {
+            fast = Date::positiveInfinity();
+        }
+        try {
+            MLDB_TRACE_EXCEPTIONS(false);
+            general = parseGeneral(str);
+        } catch (...) {
+            general = Date::positiveInfinity();
+        }
+        BOOST_CHECK_MESSAGE(fast == general, str);
+    }
+
+    std::vector<std::string> strs = { "2013-04-01", "2013-04-01T09:08:07Z" };
+    std::vector<Date> dates(strs.size());
+    Date::parseIso8601DateTimes(strs.data(), strs.size(), dates.data());
+    BOOST_CHECK_EQUAL(dates[0], Date(2013, 4, 1));
+    BOOST_CHECK_EQUAL(dates[1], Date(2013, 4, 1, 9, 8, 7));
+}
+
+BOOST_AUTO_TEST_CASE( test_iso8601_fast_print_same_as_strftime )
+{
+    std::mt19937_64 rng(1);
+    for (int i = 0;  i < 20000;  ++i) {
+        // Mostly the same day as the last one, like timestamps usually are
+        double seconds = i % 4 == 0
+            ? (double)(int64_t)(rng() % 400000000000ULL) - 300000000000.0
+            : 1348089400.0 + (rng() % 1000000) / 1000.0;
+        Date date = Date::fromSecondsSinceEpoch(seconds);
+        BOOST_REQUIRE_EQUAL(date.printClassic(),
+                            date.print("%Y-%m-%d %H:%M:%S"));
+        std::string iso = date.printIso8601(0);
+        BOOST_REQUIRE_EQUAL(iso, date.print("%Y-%m-%dT%H:%M:%S") + "Z");
+
+        // With as many digits as it takes, it reads back the same
+        if (i % 4 != 0) {
+            BOOST_REQUIRE_EQUAL
+                (Date::parseIso8601DateTime(date.printIso8601()), date);
+        }
+    }
+
+    std::vector<Date> dates = { Date(2012, 9, 19, 21, 16, 40, 0.5),
+                                Date::notADate() };
+    std::vector<std::string> printed(dates.size());
+    Date::printIso8601(dates.data(), dates.size(), printed.data());
+    BOOST_CHECK_EQUAL(printed[0], "2012-09-19T21:16:40.5Z");
+    BOOST_CHECK_EQUAL(printed[1], "NaD");
+}
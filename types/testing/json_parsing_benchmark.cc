@@ -0,0 +1,118 @@
+/** json_parsing_benchmark.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Benchmark of parsing JSON, with and without the vector instructions
+    used to scan strings and whitespace.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/types/json_parsing.h"
+#include "mldb/base/parse_context.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/arch/simd_vector.h"
+#include "mldb/arch/timers.h"
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <cmath>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+struct BenchRecord {
+    Utf8String id;
+    std::string description;
+    long long count = 0;
+    int version = 0;
+    double score = 0.0;
+    std::vector<int> tags;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(BenchRecord);
+DEFINE_STRUCTURE_DESCRIPTION(BenchRecord);
+
+BenchRecordDescription::
+BenchRecordDescription()
+{
+    addField("id", &BenchRecord::id, "");
+    addField("description", &BenchRecord::description, "");
+    addField("count", &BenchRecord::count, "");
+    addField("version", &BenchRecord::version, "");
+    addField("score", &BenchRecord::score, "");
+    addField("tags", &BenchRecord::tags, "");
+}
+
+std::string makeDocument(int numRecords)
+{
+    std::vector<BenchRecord> records;
+    for (int i = 0;  i < numRecords;  ++i) {
+        BenchRecord record;
+        record.id = "record-" + std::to_string(i);
+        record.description = "The quick brown fox jumps over the lazy dog, "
+            "for the " + std::to_string(i) + "th time";
+        record.count = i * 1234567LL;
+        record.version = i % 10;
+        record.score = i / 3.0;
+        record.tags = { i, -i, i * 2 };
+        records.push_back(record);
+    }
+
+    // Pretty-printed, to have some whitespace to skip
+    return jsonEncode(records).toStyledString();
+}
+
+template<typename Fn>
+double timeIt(int numIter, Fn && fn)
+{
+    double best = INFINITY;
+    for (int i = 0;  i < numIter;  ++i) {
+        Timer timer;
+        fn();
+        best = std::min(best, timer.elapsed_wall());
+    }
+    return best;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(benchmark_parsing)
+{
+    std::string doc = makeDocument(100000);
+    double mb = doc.size() / 1000000.0;
+
+    std::vector<SIMD::Isa> isas = { SIMD::Isa::GENERIC };
+    if (SIMD::bestSupportedIsa() != SIMD::Isa::GENERIC)
+        isas.push_back(SIMD::Isa::AVX2);
+
+    for (SIMD::Isa isa: isas) {
+        SIMD::Isa old = SIMD::setSimdIsa(isa);
+
+        size_t numRecords = 0;
+        double structures = timeIt(3, [&] ()
+            {
+                auto records = jsonDecodeStr<std::vector<BenchRecord> >(doc);
+                numRecords = records.size();
+            });
+        BOOST_CHECK_EQUAL(numRecords, 100000);
+
+        double values = timeIt(3, [&] ()
+            {
+                ParseContext context("doc", doc.data(),
+                                     doc.data() + doc.size());
+                expectJson(context);
+            });
+
+        cerr << (isa == SIMD::Isa::GENERIC ? "generic" : "avx2")
+             << ": " << doc.size() << " bytes; structures "
+             << mb / structures << "MB/s, Json::Value "
+             << mb / values << "MB/s" << endl;
+
+        SIMD::setSimdIsa(old);
+    }
+}
@@ -0,0 +1,251 @@
+/** json_parsing_simd_test.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test of the block at a time scanning of JSON strings, whitespace and
+    integers, for each instruction set and across buffer boundaries.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/types/json_parsing.h"
+#include "mldb/base/parse_context.h"
+#include "mldb/arch/simd_vector.h"
+#include "mldb/types/string.h"
+#include "mldb/ext/jsoncpp/json.h"
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <sstream>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+std::vector<SIMD::Isa> supportedIsas()
+{
+    std::vector<SIMD::Isa> result = { SIMD::Isa::GENERIC };
+    if (SIMD::bestSupportedIsa() != SIMD::Isa::GENERIC)
+        result.push_back(SIMD::Isa::AVX2);
+    return result;
+}
+
+/// Use the given instruction set until destroyed
+struct WithIsa {
+    WithIsa(SIMD::Isa isa)
+        : old(SIMD::setSimdIsa(isa))
+    {
+    }
+
+    ~WithIsa()
+    {
+        SIMD::setSimdIsa(old);
+    }
+
+    SIMD::Isa old;
+};
+
+size_t stringRun(const char * p, size_t n)
+{
+    size_t i = 0;
+    for (;  i < n;  ++i) {
+        unsigned char c = p[i];
+        if (c < ' ' || c >= 0x7f || c == '"' || c == '\\')
+            break;
+    }
+    return i;
+}
+
+size_t whitespaceRun(const char * p, size_t n)
+{
+    size_t i = 0;
+    for (;  i < n;  ++i) {
+        char c = p[i];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            break;
+    }
+    return i;
+}
+
+/// Parse str with the given chunk size, so that it's split across buffers
+template<typename Fn>
+void parseChunked(const std::string & str, size_t chunkSize, Fn && fn)
+{
+    std::istringstream stream(str);
+    ParseContext context("test", stream, 1, 1, chunkSize);
+    fn(context);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(test_kernels)
+{
+    std::mt19937 rng(1);
+
+    // Mostly the characters that are allowed, with a few that aren't, at
+    // every length and alignment
+    std::string str(300, ' ');
+    for (SIMD::Isa isa: supportedIsas()) {
+        WithIsa withIsa(isa);
+        for (int trial = 0;  trial < 200;  ++trial) {
+            const char special[] = "\"\\\x01\x7f\x80\xff\t\n\r ";
+            for (char & c: str) {
+                c = rng() % 100 == 0
+                    ? special[rng() % (sizeof(special) - 1)]
+                    : ' ' + rng() % 95;
+            }
+            for (size_t ofs = 0;  ofs < 70;  ofs += 3) {
+                for (size_t n = 0;  n + ofs <= str.size();  n += 7) {
+                    BOOST_REQUIRE_EQUAL
+                        (SIMD::vec_json_string_run(str.data() + ofs, n),
+                         stringRun(str.data() + ofs, n));
+                }
+            }
+
+            for (char & c: str) {
+                c = rng() % 100 == 0 ? 'x' : "\t\n\r "[rng() % 4];
+            }
+            for (size_t ofs = 0;  ofs < 70;  ofs += 3) {
+                for (size_t n = 0;  n + ofs <= str.size();  n += 7) {
+                    BOOST_REQUIRE_EQUAL
+                        (SIMD::vec_json_whitespace_run(str.data() + ofs, n),
+                         whitespaceRun(str.data() + ofs, n));
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_long_strings)
+{
+    std::string plain;
+    for (int i = 0;  i < 500;  ++i)
+        plain += 'a' + i % 26;
+
+    std::string value = plain + "\\\"\\n\\u00e9" + plain
+        + "caf\xc3\xa9 \xe2\x82\xac" + plain;
+    std::string expected = plain + "\"\n\xc3\xa9" + plain
+        + "caf\xc3\xa9 \xe2\x82\xac" + plain;
+    std::string json = "  \"" + value + "\" ";
+
+    for (SIMD::Isa isa: supportedIsas()) {
+        WithIsa withIsa(isa);
+        for (size_t chunkSize: { 1, 7, 64, 65500 }) {
+            parseChunked(json, chunkSize, [&] (ParseContext & context)
+                {
+                    StreamingJsonParsingContext parser(context);
+                    BOOST_CHECK_EQUAL(parser.expectStringUtf8(),
+                                      Utf8String(expected));
+                });
+            parseChunked(json, chunkSize, [&] (ParseContext & context)
+                {
+                    BOOST_CHECK_EQUAL(expectJson(context).asString(),
+                                      expected);
+                });
+            parseChunked(json, chunkSize, [&] (ParseContext & context)
+                {
+                    std::string result;
+                    BOOST_CHECK(matchJsonString(context, result));
+                    BOOST_CHECK_EQUAL(result.size(), plain.size() * 3 + 12);
+                });
+
+            // Into a fixed buffer, which is too small the first time
+            parseChunked(json, chunkSize, [&] (ParseContext & context)
+                {
+                    StreamingJsonParsingContext parser(context);
+                    char buf[100];
+                    BOOST_CHECK_EQUAL(parser.expectStringUtf8(buf, 100), -1);
+                });
+            parseChunked(json, chunkSize, [&] (ParseContext & context)
+                {
+                    StreamingJsonParsingContext parser(context);
+                    std::vector<char> buf(4096);
+                    ssize_t len = parser.expectStringUtf8(buf.data(), 4096);
+                    BOOST_CHECK_EQUAL(std::string(buf.data(), len), expected);
+                });
+
+            std::string ascii = "\"" + plain + "\\t" + plain + "\"";
+            parseChunked(ascii, chunkSize, [&] (ParseContext & context)
+                {
+                    BOOST_CHECK_EQUAL(expectJsonStringAscii(context),
+                                      plain + "\t" + plain);
+                });
+            parseChunked(ascii, chunkSize, [&] (ParseContext & context)
+                {
+                    char buf[2000];
+                    ssize_t len = expectJsonStringAscii(context, buf, 2000);
+                    BOOST_CHECK_EQUAL(std::string(buf, len),
+                                      plain + "\t" + plain);
+                });
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_whitespace_positions)
+{
+    // Errors must still be reported at the right line and column after
+    // skipping whitespace in bulk
+    std::string json = "{\n  \"a\": 1,\r\n\t\"b\" :\n\n" + std::string(100, ' ')
+        + "@}";
+
+    for (SIMD::Isa isa: supportedIsas()) {
+        WithIsa withIsa(isa);
+        for (size_t chunkSize: { 1, 5, 64, 65500 }) {
+            parseChunked(json, chunkSize, [&] (ParseContext & context)
+                {
+                    try {
+                        MLDB_TRACE_EXCEPTIONS(false);
+                        expectJson(context);
+                        BOOST_ERROR("expected an exception");
+                    } catch (const std::exception & exc) {
+                        std::string what = exc.what();
+                        BOOST_CHECK_MESSAGE(what.find("test:5:101") == 0,
+                                            what);
+                    }
+                });
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_integers)
+{
+    std::string json = "[0, -0, 1, -1, 123456789012345678, -123456789012345678,"
+        "1234567890123456789, 18446744073709551615, -9223372036854775808,"
+        "12.5, 1e3, -7E-1, 42 ]";
+
+    for (size_t chunkSize: { 1, 2, 3, 5, 8, 13, 65500 }) {
+        parseChunked(json, chunkSize, [&] (ParseContext & context)
+            {
+                Json::Value val = expectJson(context);
+                BOOST_REQUIRE_EQUAL(val.size(), 13);
+                BOOST_CHECK_EQUAL(val[0].asInt(), 0);
+                BOOST_CHECK_EQUAL(val[1].asInt(), 0);
+                BOOST_CHECK_EQUAL(val[2].asInt(), 1);
+                BOOST_CHECK_EQUAL(val[3].asInt(), -1);
+                BOOST_CHECK_EQUAL(val[4].asUInt(), 123456789012345678ULL);
+                BOOST_CHECK_EQUAL(val[5].asInt(), -123456789012345678LL);
+                BOOST_CHECK_EQUAL(val[6].asUInt(), 1234567890123456789ULL);
+                BOOST_CHECK_EQUAL(val[7].asUInt(), 18446744073709551615ULL);
+                BOOST_CHECK_EQUAL(val[8].asInt(),
+                                  std::numeric_limits<long long>::min());
+                BOOST_CHECK_EQUAL(val[9].asDouble(), 12.5);
+                BOOST_CHECK_EQUAL(val[10].asDouble(), 1000.0);
+                BOOST_CHECK_EQUAL(val[11].asDouble(), -0.7);
+                BOOST_CHECK_EQUAL(val[12].asInt(), 42);
+            });
+
+        parseChunked("12345 -678 +9 x", chunkSize, [&] (ParseContext & context)
+            {
+                BOOST_CHECK_EQUAL(context.expect_long_long(), 12345);
+                context.expect_literal(' ');
+                BOOST_CHECK_EQUAL(context.expect_int(), -678);
+                context.expect_literal(' ');
+                BOOST_CHECK_EQUAL(context.expect_long_long(), 9);
+                context.expect_literal(' ');
+                int i;
+                BOOST_CHECK(!context.match_int(i));
+                BOOST_CHECK_EQUAL(*context, 'x');
+            });
+    }
+}
@@ -0,0 +1,164 @@
+/** json_printing_benchmark.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Benchmark of printing structures to JSON, through the descriptions of
+    their fields and directly.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/types/structure_description.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/dtoa.h"
+#include "mldb/arch/timers.h"
+
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+struct BenchEntry {
+    Utf8String id;
+    std::string type;
+    bool persistent = false;
+    int numRows = 0;
+    long long memoryBytes = 0;
+    double loadingSeconds = 0.0;
+    double progress = 0.0;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(BenchEntry);
+DEFINE_STRUCTURE_DESCRIPTION(BenchEntry);
+
+BenchEntryDescription::
+BenchEntryDescription()
+{
+    addField("id", &BenchEntry::id, "");
+    addField("type", &BenchEntry::type, "");
+    addField("persistent", &BenchEntry::persistent, "");
+    addField("numRows", &BenchEntry::numRows, "");
+    addField("memoryBytes", &BenchEntry::memoryBytes, "");
+    addField("loadingSeconds", &BenchEntry::loadingSeconds, "");
+    addField("progress", &BenchEntry::progress, "", 0.0);
+}
+
+struct BenchResponse {
+    std::vector<BenchEntry> entries;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(BenchResponse);
+DEFINE_STRUCTURE_DESCRIPTION(BenchResponse);
+
+BenchResponseDescription::
+BenchResponseDescription()
+{
+    addField("entries", &BenchResponse::entries, "");
+}
+
+BenchResponse makeResponse(int numEntries)
+{
+    BenchResponse result;
+    for (int i = 0;  i < numEntries;  ++i) {
+        BenchEntry entry;
+        entry.id = "dataset" + std::to_string(i);
+        entry.type = "sparse.mutable";
+        entry.persistent = i % 2;
+        entry.numRows = i * 1000;
+        entry.memoryBytes = i * 123456789LL;
+        entry.loadingSeconds = i / 7.0;
+        entry.progress = i % 3 ? 0.25 * (i % 4) : 0.0;
+        result.entries.push_back(entry);
+    }
+    return result;
+}
+
+template<typename Fn>
+double timeIt(int numIter, Fn && fn)
+{
+    double best = INFINITY;
+    for (int i = 0;  i < numIter;  ++i) {
+        Timer timer;
+        fn();
+        best = std::min(best, timer.elapsed_wall());
+    }
+    return best;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(benchmark_structures)
+{
+    auto desc = getDefaultDescriptionSharedT<BenchResponse>();
+
+    for (int numEntries: { 10, 1000, 100000 }) {
+        BenchResponse response = makeResponse(numEntries);
+        int numIter = std::max(3, 1000000 / numEntries);
+        size_t bytes = 0;
+
+        double stream = timeIt(numIter, [&] ()
+            {
+                std::ostringstream out;
+                StreamJsonPrintingContext context(out);
+                desc->printJson(&response, context);
+                bytes = out.str().size();
+            });
+
+        double described = timeIt(numIter, [&] ()
+            {
+                std::string out;
+                StringJsonPrintingContext context(out);
+                // No raw output, so through the descriptions
+                context.writeUtf8 = false;
+                desc->printJson(&response, context);
+            });
+
+        double raw = timeIt(numIter, [&] ()
+            {
+                std::string out;
+                StringJsonPrintingContext context(out);
+                desc->printJson(&response, context);
+            });
+
+        cerr << numEntries << " entries, " << bytes << " bytes: stream "
+             << stream * 1e6 << "us, string " << described * 1e6
+             << "us, raw " << raw * 1e6 << "us; "
+             << stream / raw << "x faster than stream" << endl;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(benchmark_doubles)
+{
+    std::vector<double> vals;
+    for (int i = 0;  i < 1000000;  ++i)
+        vals.push_back(i % 2 ? i / 7.0 : i * 1e-9);
+
+    size_t totalDtoa = 0;
+    double dtoaTime = timeIt(3, [&] ()
+        {
+            for (double d: vals)
+                totalDtoa += MLDB::dtoa(d).size();
+        });
+
+    size_t totalAppend = 0;
+    double appendTime = timeIt(3, [&] ()
+        {
+            std::string out;
+            for (double d: vals) {
+                out.clear();
+                appendJsonDouble(d, out);
+                totalAppend += out.size();
+            }
+        });
+
+    BOOST_CHECK_EQUAL(totalDtoa, totalAppend);
+    cerr << vals.size() << " doubles: dtoa " << dtoaTime * 1e3
+         << "ms, appendJsonDouble " << appendTime * 1e3 << "ms; "
+         << dtoaTime / appendTime << "x faster" << endl;
+}
@@ -0,0 +1,93 @@
+/* path_table_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Tests for the table of interned paths.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/types/path_table.h"
+#include "mldb/arch/exception_handler.h"
+#include <thread>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_intern )
+{
+    PathTable table;
+    BOOST_CHECK_EQUAL(table.size(), 0);
+
+    Path p1 = Path::parse("x.y");
+    Path p2 = Path::parse("a very long column name that isn't stored inline.z");
+
+    uint32_t id1 = table.intern(p1);
+    uint32_t id2 = table.intern(p2);
+    BOOST_CHECK_NE(id1, id2);
+    BOOST_CHECK_EQUAL(table.intern(Path::parse("x.y")), id1);
+    BOOST_CHECK_EQUAL(table.size(), 2);
+
+    BOOST_CHECK_EQUAL(table.path(id2), p2);
+    BOOST_CHECK_EQUAL(table.hash(id1), p1.hash());
+
+    uint32_t id;
+    BOOST_CHECK(table.find(p2, id));
+    BOOST_CHECK_EQUAL(id, id2);
+    BOOST_CHECK(!table.find(Path::parse("x"), id));
+    BOOST_CHECK_EQUAL(table.size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_intern_many_threads )
+{
+    // Enough paths to need several chunks, interned from several threads
+    // at once; each must get a single id.
+    PathTable table;
+    int numPaths = 20000;
+    std::vector<std::vector<uint32_t> > ids(4);
+
+    auto run = [&] (int thread)
+        {
+            for (int i = 0;  i < numPaths;  ++i) {
+                int n = (i * 7 + thread * 13) % numPaths;
+                ids[thread].push_back(table.intern(PathElement(n)));
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < 4;  ++i)
+        threads.emplace_back(run, i);
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(table.size(), numPaths);
+    for (int thread = 0;  thread < 4;  ++thread) {
+        for (int i = 0;  i < numPaths;  ++i) {
+            int n = (i * 7 + thread * 13) % numPaths;
+            BOOST_CHECK_EQUAL(table.path(ids[thread][i]), Path(PathElement(n)));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_position_index )
+{
+    PathTable table;
+    PathPositionIndex index(table);
+
+    BOOST_CHECK(index.add(PathElement("a")));
+    BOOST_CHECK(index.add(PathElement("b")));
+    BOOST_CHECK(index.add(Path::parse("c.d")));
+    BOOST_CHECK(!index.add(PathElement("b")));
+    BOOST_CHECK_EQUAL(index.size(), 3);
+    BOOST_CHECK_EQUAL(index[2], Path::parse("c.d"));
+
+    // Right, wrong, out of range and no expected position all find it
+    for (int expected: { 1, 0, 10, -1 })
+        BOOST_CHECK_EQUAL(index.find(PathElement("b"), expected), 1);
+    BOOST_CHECK_EQUAL(index.find(PathElement("c"), 2), -1);
+    BOOST_CHECK_EQUAL(index.find(Path::parse("c.d")), 2);
+}
@@ -0,0 +1,263 @@
+/** structure_json_test.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Test that the fields of structures that are printed and parsed without
+    going through their descriptions give the same JSON as those that are.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/types/structure_description.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/dtoa.h"
+
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <random>
+#include <cstring>
+#include <cmath>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+struct RawBase {
+    int baseInt = 0;
+    std::string baseString;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(RawBase);
+DEFINE_STRUCTURE_DESCRIPTION(RawBase);
+
+RawBaseDescription::
+RawBaseDescription()
+{
+    addField("baseInt", &RawBase::baseInt, "");
+    addField("baseString", &RawBase::baseString, "");
+}
+
+struct RawInner {
+    double x = 0.0;
+    Utf8String label;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(RawInner);
+DEFINE_STRUCTURE_DESCRIPTION(RawInner);
+
+RawInnerDescription::
+RawInnerDescription()
+{
+    addField("x", &RawInner::x, "");
+    addField("label", &RawInner::label, "");
+}
+
+struct RawStruct: public RawBase {
+    bool b = false;
+    short s = 0;
+    unsigned short us = 0;
+    int i = 0;
+    unsigned u = 0;
+    long l = 0;
+    unsigned long ul = 0;
+    long long ll = 0;
+    unsigned long long ull = 0;
+    float f = 0.0;
+    double d = 0.0;
+    std::string str;
+    Utf8String utf8;
+    int withDefault = 3;
+    double doubleWithDefault = 1.5;
+    std::vector<int> vec;
+    RawInner inner;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(RawStruct);
+DEFINE_STRUCTURE_DESCRIPTION(RawStruct);
+
+RawStructDescription::
+RawStructDescription()
+{
+    addParent<RawBase>();
+    addField("b", &RawStruct::b, "");
+    addField("s", &RawStruct::s, "");
+    addField("us", &RawStruct::us, "");
+    addField("i", &RawStruct::i, "");
+    addField("u", &RawStruct::u, "");
+    addField("l", &RawStruct::l, "");
+    addField("ul", &RawStruct::ul, "");
+    addField("ll", &RawStruct::ll, "");
+    addField("ull", &RawStruct::ull, "");
+    addField("f", &RawStruct::f, "");
+    addField("d", &RawStruct::d, "");
+    addField("str", &RawStruct::str, "");
+    addField("utf8", &RawStruct::utf8, "");
+    addField("withDefault", &RawStruct::withDefault, "", 3);
+    addField("doubleWithDefault", &RawStruct::doubleWithDefault, "", 1.5);
+    addField("vec", &RawStruct::vec, "");
+    addField("inner", &RawStruct::inner, "");
+}
+
+RawStruct makeStruct()
+{
+    RawStruct result;
+    result.baseInt = -7;
+    result.baseString = "base";
+    result.b = true;
+    result.s = -3;
+    result.us = 65535;
+    result.i = -2000000000;
+    result.u = 3000000000u;
+    result.l = -(1L << 40);
+    result.ul = 1UL << 63;
+    result.ll = -(1LL << 62);
+    result.ull = 18446744073709551615ULL;
+    result.f = 0.1f;
+    result.d = 1.0 / 3.0;
+    result.str = "tab\there \"quoted\" back\\slash";
+    result.utf8 = "line\nbreak";
+    result.withDefault = 4;
+    result.vec = { 1, 2, 3 };
+    result.inner.x = 1e-7;
+    result.inner.label = "inner";
+    return result;
+}
+
+/// Printed through the descriptions of each field, as the stream context
+/// doesn't allow for raw output
+std::string printStream(const RawStruct & val)
+{
+    std::ostringstream stream;
+    StreamJsonPrintingContext context(stream);
+    getDefaultDescriptionSharedT<RawStruct>()->printJson(&val, context);
+    return stream.str();
+}
+
+std::string printRaw(const RawStruct & val)
+{
+    std::string result;
+    StringJsonPrintingContext context(result);
+    BOOST_REQUIRE(context.rawOutput());
+    getDefaultDescriptionSharedT<RawStruct>()->printJson(&val, context);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(test_raw_fields)
+{
+    auto desc = getDefaultDescriptionSharedT<RawStruct>();
+    auto & structDesc = dynamic_cast<const StructureDescription<RawStruct> &>(*desc);
+    BOOST_REQUIRE_EQUAL(structDesc.rawFields.size(),
+                        structDesc.orderedFields.size());
+
+    for (size_t i = 0;  i < structDesc.orderedFields.size();  ++i) {
+        std::string name = structDesc.orderedFields[i]->first;
+        auto & raw = structDesc.rawFields[i];
+        BOOST_CHECK_EQUAL(raw.quotedName, "\"" + name + "\":");
+        bool simple = name != "vec" && name != "inner";
+        BOOST_CHECK_EQUAL(raw.print != nullptr, simple);
+        BOOST_CHECK_EQUAL(raw.parse != nullptr, simple);
+        // Fields with a default value ask their description
+        bool hasDefault = name == "withDefault" || name == "doubleWithDefault";
+        BOOST_CHECK_EQUAL(raw.isDefault != nullptr, simple && !hasDefault);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_same_output)
+{
+    RawStruct val = makeStruct();
+    std::string raw = printRaw(val);
+    BOOST_CHECK_EQUAL(raw, printStream(val));
+    BOOST_CHECK_EQUAL(raw, jsonEncodeStr(val));
+
+    // Default values are skipped in the same way
+    RawStruct empty;
+    BOOST_CHECK_EQUAL(printRaw(empty), printStream(empty));
+    BOOST_CHECK(printRaw(empty).find("str") == std::string::npos);
+    BOOST_CHECK(printRaw(empty).find("withDefault") == std::string::npos);
+
+    // Utf-8 characters are written as they are
+    val.utf8 = "caf\xc3\xa9 \xe2\x82\xac";
+    BOOST_CHECK_EQUAL(printRaw(val), printStream(val));
+}
+
+BOOST_AUTO_TEST_CASE(test_round_trip)
+{
+    RawStruct val = makeStruct();
+    RawStruct decoded = jsonDecodeStr<RawStruct>(printRaw(val));
+
+    BOOST_CHECK_EQUAL(decoded.baseInt, val.baseInt);
+    BOOST_CHECK_EQUAL(decoded.baseString, val.baseString);
+    BOOST_CHECK_EQUAL(decoded.b, val.b);
+    BOOST_CHECK_EQUAL(decoded.s, val.s);
+    BOOST_CHECK_EQUAL(decoded.us, val.us);
+    BOOST_CHECK_EQUAL(decoded.i, val.i);
+    BOOST_CHECK_EQUAL(decoded.u, val.u);
+    BOOST_CHECK_EQUAL(decoded.l, val.l);
+    BOOST_CHECK_EQUAL(decoded.ul, val.ul);
+    BOOST_CHECK_EQUAL(decoded.ll, val.ll);
+    BOOST_CHECK_EQUAL(decoded.ull, val.ull);
+    BOOST_CHECK_EQUAL(decoded.f, val.f);
+    BOOST_CHECK_EQUAL(decoded.d, val.d);
+    BOOST_CHECK_EQUAL(decoded.str, val.str);
+    BOOST_CHECK_EQUAL(decoded.utf8, val.utf8);
+    BOOST_CHECK_EQUAL(decoded.withDefault, val.withDefault);
+    BOOST_CHECK_EQUAL(decoded.doubleWithDefault, val.doubleWithDefault);
+    BOOST_CHECK(decoded.vec == val.vec);
+    BOOST_CHECK_EQUAL(decoded.inner.x, val.inner.x);
+    BOOST_CHECK_EQUAL(decoded.inner.label, val.inner.label);
+}
+
+BOOST_AUTO_TEST_CASE(test_append_json_double)
+{
+    auto print = [] (double d)
+        {
+            std::string result;
+            appendJsonDouble(d, result);
+            return result;
+        };
+
+    BOOST_CHECK_EQUAL(print(0.0), "0.0");
+    BOOST_CHECK_EQUAL(print(-0.0), "0.0");
+    BOOST_CHECK_EQUAL(print(1.0), "1.0");
+    BOOST_CHECK_EQUAL(print(-2.5), "-2.5");
+    BOOST_CHECK_EQUAL(print(100.0), "1e2");
+    BOOST_CHECK_EQUAL(print(0.001), "0.001");
+    BOOST_CHECK_EQUAL(print(1e-7), "1e-7");
+    BOOST_CHECK_EQUAL(print(0.1), "0.1");
+    BOOST_CHECK_EQUAL(print(1e300), "1e300");
+    BOOST_CHECK_EQUAL(print(INFINITY), "\"inf\"");
+
+    // The same as dtoa() for the values that are commonly printed...
+    for (double d: { 0.1, 1.0 / 3, 123.456, 5e-324, 1.7976931348623157e308,
+                     -12345678.9, (double)0.1f, 1e-5, 1e-6, 65536.0, 1e21 }) {
+        BOOST_CHECK_EQUAL(print(d), MLDB::dtoa(d));
+    }
+
+    std::mt19937_64 rng(1);
+    for (int i = 0;  i < 100000;  ++i) {
+        double d = (int64_t)(rng() % 100000000) / 1000.0;
+        BOOST_CHECK_EQUAL(print(d), MLDB::dtoa(d));
+    }
+
+    // ... and always read back as the same value
+    for (int i = 0;  i < 100000;  ++i) {
+        uint64_t bits = rng();
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        if (!std::isfinite(d))
+            continue;
+        BOOST_CHECK_EQUAL(strtod(print(d).c_str(), nullptr), d);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_append_json_string_utf8)
+{
+    std::string out;
+    const char * str = "a\"b\\c\td\xc3\xa9/";
+    appendJsonStringUtf8(str, strlen(str), out);
+    BOOST_CHECK_EQUAL(out, "\"a\\\"b\\\\c\\td\xc3\xa9/\"");
+}
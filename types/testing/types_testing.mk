@@ -10,3 +10,8 @@ $(eval $(call test,reader_test,jsoncpp arch types,boost))
 $(eval $(call test,json_parsing_test,types arch,boost))
 $(eval $(call test,any_test,any types arch,boost))
 $(eval $(call test,decode_uri_test,types,boost))
+$(eval $(call test,path_table_test,types arch,boost))
+$(eval $(call test,structure_json_test,types arch value_description,boost))
+$(eval $(call test,json_printing_benchmark,types arch value_description,boost manual))
+$(eval $(call test,json_parsing_simd_test,types arch,boost))
+$(eval $(call test,json_parsing_benchmark,types arch value_description,boost manual))
@@ -34,6 +34,7 @@ LIBTYPES_SOURCES := \
 	regex.cc \
 	periodic_utils_value_descriptions.cc \
 	path.cc \
+	path_table.cc \
 	annotated_exception.cc \
 
 LIBTYPES_LINK := \
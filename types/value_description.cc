@@ -422,6 +422,7 @@ operator = (const StructureDescriptionBase & other)
             .first;
         orderedFields.push_back(it);
     }
+    rawFields = other.rawFields;
 }
 
 void
@@ -434,9 +435,22 @@ operator = (StructureDescriptionBase && other)
     fields = std::move(other.fields);
     fieldNames = std::move(other.fieldNames);
     orderedFields = std::move(other.orderedFields);
+    rawFields = std::move(other.rawFields);
     // don't set owner
 }
 
+void
+StructureDescriptionBase::
+addRawField(RawField raw)
+{
+    ExcAssertEqual(rawFields.size() + 1, orderedFields.size());
+    const char * name = orderedFields.back()->first;
+    raw.quotedName.clear();
+    appendJsonStringUtf8(name, strlen(name), raw.quotedName);
+    raw.quotedName += ':';
+    rawFields.emplace_back(std::move(raw));
+}
+
 StructureDescriptionBase::Exception::
 Exception(JsonParsingContext & context,
           const std::string & message)
@@ -497,10 +511,11 @@ parseJson(void * output, JsonParsingContext & context) const
                         context.onUnknownField(owner);
                     }
                     else {
-                        it->second.description
-                        ->parseJson(addOffset(output,
-                                              it->second.offset),
-                                    context);
+                        void * mbr = addOffset(output, it->second.offset);
+                        auto parse = rawFields[it->second.fieldNum].parse;
+                        if (parse)
+                            parse(mbr, context);
+                        else it->second.description->parseJson(mbr, context);
                     }
                 }
                 catch (const Exception & exc) {
@@ -536,14 +551,28 @@ printJson(const void * input, JsonPrintingContext & context) const
 {
     context.startObject();
 
-    for (const auto & it: orderedFields) {
-        auto & fd = it->second;
+    // Fields of simple types are appended straight to the output if
+    // the context allows it
+    std::string * raw = context.rawOutput();
+
+    for (size_t i = 0;  i < orderedFields.size();  ++i) {
+        auto & fd = orderedFields[i]->second;
+        auto & rawField = rawFields[i];
 
         const void * mbr = addOffset(input, fd.offset);
-        if (fd.description->isDefault(mbr))
+        if (rawField.isDefault
+            ? rawField.isDefault(mbr)
+            : fd.description->isDefault(mbr))
             continue;
-        context.startMember(it->first);
-        fd.description->printJson(mbr, context);
+
+        if (raw && rawField.print) {
+            context.startMemberRaw(rawField.quotedName);
+            rawField.print(mbr, *raw);
+        }
+        else {
+            context.startMember(orderedFields[i]->first);
+            fd.description->printJson(mbr, context);
+        }
     }
         
     context.endObject();
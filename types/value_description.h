@@ -17,6 +17,7 @@
 #include <set>
 #include "mldb/arch/exception.h"
 #include "mldb/arch/demangle.h"
+#include "mldb/arch/profile_scope.h"
 #include "mldb/base/exc_assert.h"
 #include "json_parsing.h"
 #include "json_printing.h"
@@ -623,6 +624,7 @@ void jsonDecodeFile(const std::string & filename, T & val)
 template<typename T>
 Json::Value jsonEncode(const T & obj)
 {
+    MLDB_PROFILE_SCOPE("json.encode");
     static auto desc = getDefaultDescriptionSharedT<T>();
     Json::Value output;
     StructuredJsonPrintingContext context(output);
@@ -635,6 +637,7 @@ Json::Value jsonEncode(const T & obj)
 template<typename T>
 std::string jsonEncodeStr(const T & obj)
 {
+    MLDB_PROFILE_SCOPE("json.encode");
     static auto desc = getDefaultDescriptionSharedT<T>();
     std::string result;
     result.reserve(116);  /// try to force a 128 byte allocation
@@ -649,6 +652,7 @@ std::string jsonEncodeStr(const T & obj)
 template<typename T>
 Utf8String jsonEncodeUtf8(const T & obj)
 {
+    MLDB_PROFILE_SCOPE("json.encode");
     static auto desc = getDefaultDescriptionSharedT<T>();
     Utf8String result;
     result.reserve(116); // try for a 128 byte allocation
@@ -664,6 +668,7 @@ template<typename T>
 std::ostream & jsonEncodeToStream(const T & obj,
                                   std::ostream & stream)
 {
+    MLDB_PROFILE_SCOPE("json.encode");
     static auto desc = getDefaultDescriptionSharedT<T>();
     StreamJsonPrintingContext context(stream);
     desc->printJson(&obj, context);
@@ -0,0 +1,425 @@
+/** hnsw_index.h                                                   -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Hierarchical Navigable Small World graph, for approximate nearest
+    neighbour queries.  See Malkov and Yashunin, "Efficient and robust
+    approximate nearest neighbor search using Hierarchical Navigable Small
+    World graphs", 2016.
+*/
+
+#pragma once
+
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/exception.h"
+#include "mldb/types/db/persistent.h"
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+/** Approximate nearest neighbour index over a set of items, which are
+    arranged in a hierarchy of proximity graphs.  Each item is linked to
+    around M of its closest neighbours (2M on the bottom level), and
+    appears on each level with a probability decreasing by a factor of M.
+    A query descends greedily from the sparse top level to the bottom one,
+    and then does a beam search of width efSearch.
+
+    Like the VantagePointTreeT, the index doesn't know about coordinates;
+    distances are calculated by the functions passed in.  Unlike it, items
+    can be inserted one by one, each insertion costing around
+    efConstruction distance calculations per level.
+
+    Inserting requires external synchronization; searching is const and
+    may be done from any number of threads at once.
+*/
+template<typename Item>
+struct HnswIndexT {
+
+    /// Distance between two items already in (or being inserted into) the
+    /// index.
+    typedef std::function<float (Item, Item)> PairDistance;
+
+    /// Distance from the item being searched for to the given item.
+    typedef std::function<float (Item)> Distance;
+
+    HnswIndexT(int M = 16, int efConstruction = 200, uint64_t seed = 1)
+        : M(M), efConstruction(efConstruction), seed(seed)
+    {
+        ExcAssertGreaterEqual(M, 2);
+        ExcAssertGreaterEqual(efConstruction, 1);
+    }
+
+    /** Insert the given item, linking it into the graph.  If the distance
+        function throws, the index is left unchanged.
+    */
+    void insert(Item item, const PairDistance & distance)
+    {
+        uint32_t node = nodes.size();
+        int level = randomLevel(node);
+
+        if (nodes.empty()) {
+            nodes.emplace_back(std::move(item), level);
+            entryPoint = 0;
+            maxLevel = level;
+            return;
+        }
+
+        auto nodeDistance = [&] (uint32_t n1, uint32_t n2) -> float
+            {
+                return distance(nodes[n1].item, nodes[n2].item);
+            };
+
+        auto distanceToItem = [&] (uint32_t n) -> float
+            {
+                return distance(item, nodes[n].item);
+            };
+
+        // Find the neighbours on each level before anything is modified,
+        // so that all of the distances involving the new item have been
+        // calculated successfully before the graph changes.
+        std::vector<Candidate> entry
+            = { { distanceToItem(entryPoint), entryPoint } };
+
+        for (int l = maxLevel;  l > level;  --l)
+            entry = searchLevel(distanceToItem, entry, 1, l);
+
+        int topLevel = std::min(level, maxLevel);
+        std::vector<std::vector<Candidate> > neighbours(topLevel + 1);
+
+        for (int l = topLevel;  l >= 0;  --l) {
+            entry = searchLevel(distanceToItem, entry, efConstruction, l);
+            neighbours[l] = selectNeighbours(entry, M, nodeDistance);
+        }
+
+        nodes.emplace_back(std::move(item), level);
+
+        for (int l = 0;  l <= topLevel;  ++l) {
+            size_t maxLinks = maxLinksAtLevel(l);
+
+            for (auto & n: neighbours[l]) {
+                nodes[node].links[l].push_back(n.second);
+
+                std::vector<uint32_t> & links = nodes[n.second].links[l];
+                links.push_back(node);
+
+                if (links.size() <= maxLinks)
+                    continue;
+
+                // Too many links; keep the most useful ones
+                std::vector<Candidate> candidates;
+                candidates.reserve(links.size());
+                for (uint32_t link: links)
+                    candidates.emplace_back(nodeDistance(n.second, link), link);
+                std::sort(candidates.begin(), candidates.end());
+
+                links.clear();
+                for (auto & c: selectNeighbours(candidates, maxLinks,
+                                                nodeDistance))
+                    links.push_back(c.second);
+            }
+        }
+
+        if (level > maxLevel) {
+            maxLevel = level;
+            entryPoint = node;
+        }
+    }
+
+    /** Return the (approximately) n closest items, which must all have a
+        distance of at most maximumDist, sorted by distance.  efSearch is
+        the width of the search on the bottom level; higher values trade
+        speed for recall.
+    */
+    std::vector<std::pair<float, Item> >
+    search(const Distance & distance, int n, float maximumDist,
+           int efSearch) const
+    {
+        std::vector<std::pair<float, Item> > result;
+        if (nodes.empty() || n <= 0)
+            return result;
+
+        auto distanceToNode = [&] (uint32_t node) -> float
+            {
+                return distance(nodes[node].item);
+            };
+
+        std::vector<Candidate> entry
+            = { { distanceToNode(entryPoint), entryPoint } };
+
+        for (int l = maxLevel;  l > 0;  --l)
+            entry = searchLevel(distanceToNode, entry, 1, l);
+
+        entry = searchLevel(distanceToNode, entry, std::max(efSearch, n), 0);
+
+        for (auto & c: entry) {
+            if (result.size() == n || c.first > maximumDist)
+                break;
+            result.emplace_back(c.first, nodes[c.second].item);
+        }
+
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    size_t size() const
+    {
+        return nodes.size();
+    }
+
+    size_t memusage() const
+    {
+        size_t result = sizeof(*this) + sizeof(Node) * nodes.capacity();
+        for (auto & n: nodes) {
+            for (auto & l: n.links)
+                result += sizeof(l) + sizeof(uint32_t) * l.capacity();
+        }
+        return result;
+    }
+
+    void serialize(DB::Store_Writer & store) const
+    {
+        using namespace MLDB::DB;
+        store << std::string("HNSW") << compact_size_t(1)  // version
+              << compact_size_t(M) << compact_size_t(efConstruction)
+              << seed << compact_size_t(nodes.size());
+        if (nodes.empty())
+            return;
+        store << compact_size_t(entryPoint) << compact_size_t(maxLevel);
+
+        for (auto & n: nodes) {
+            store << n.item << compact_size_t(n.links.size());
+            for (auto & l: n.links) {
+                store << compact_size_t(l.size());
+                for (uint32_t link: l)
+                    store << compact_size_t(link);
+            }
+        }
+    }
+
+    void reconstitute(DB::Store_Reader & store)
+    {
+        using namespace MLDB::DB;
+        std::string tag;
+        store >> tag;
+        if (tag != "HNSW")
+            throw MLDB::Exception("Expected HNSW index; got '" + tag + "'");
+        compact_size_t version(store);
+        if ((size_t)version != 1)
+            throw MLDB::Exception("Unknown HNSW index version %d",
+                                  (int)version);
+
+        compact_size_t m(store), ef(store);
+        M = m;
+        efConstruction = ef;
+        store >> seed;
+
+        compact_size_t numNodes(store);
+        nodes.clear();
+        entryPoint = 0;
+        maxLevel = -1;
+        if (numNodes == 0)
+            return;
+
+        compact_size_t ep(store), ml(store);
+        entryPoint = ep;
+        maxLevel = ml;
+
+        nodes.reserve(numNodes);
+        for (size_t i = 0;  i < numNodes;  ++i) {
+            Item item;
+            store >> item;
+            compact_size_t numLevels(store);
+            ExcAssertGreaterEqual((size_t)numLevels, 1);
+            nodes.emplace_back(std::move(item), (int)numLevels - 1);
+            for (auto & l: nodes.back().links) {
+                compact_size_t numLinks(store);
+                l.reserve(numLinks);
+                for (size_t j = 0;  j < numLinks;  ++j) {
+                    compact_size_t link(store);
+                    ExcAssertLess((size_t)link, (size_t)numNodes);
+                    l.push_back(link);
+                }
+            }
+        }
+
+        ExcAssertLess(entryPoint, nodes.size());
+        ExcAssertEqual(nodes[entryPoint].links.size(), maxLevel + 1);
+    }
+
+private:
+    /// Distance and node number of a search candidate
+    typedef std::pair<float, uint32_t> Candidate;
+
+    struct Node {
+        Node(Item item, int level)
+            : item(std::move(item)), links(level + 1)
+        {
+        }
+
+        Item item;
+        std::vector<std::vector<uint32_t> > links;  ///< Per level
+    };
+
+    int M;
+    int efConstruction;
+    uint64_t seed;
+    std::vector<Node> nodes;
+    uint32_t entryPoint = 0;
+    int maxLevel = -1;
+
+    /** Set of visited nodes, which is cleared by incrementing the epoch
+        rather than by touching every node.
+    */
+    struct VisitedSet {
+        std::vector<uint32_t> marks;
+        uint32_t epoch = 0;
+
+        void clear(size_t numNodes)
+        {
+            if (marks.size() < numNodes)
+                marks.resize(numNodes, 0);
+            if (++epoch == 0) {
+                std::fill(marks.begin(), marks.end(), 0);
+                epoch = 1;
+            }
+        }
+
+        bool insert(uint32_t node)
+        {
+            if (marks[node] == epoch)
+                return false;
+            marks[node] = epoch;
+            return true;
+        }
+    };
+
+    size_t maxLinksAtLevel(int level) const
+    {
+        return level == 0 ? 2 * M : M;
+    }
+
+    /** Level of the given node, which is drawn from a geometric
+        distribution.  This is a function of the seed and node number only,
+        so that it doesn't depend upon the state of a generator and the
+        same graph is built whenever the same items are inserted.
+    */
+    int randomLevel(uint64_t node) const
+    {
+        // splitmix64 hash of the seed and node number
+        uint64_t z = seed + (node + 1) * 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z = z ^ (z >> 31);
+
+        // Uniform in (0, 1]
+        double u = ((z >> 11) + 1) * (1.0 / 9007199254740992.0);
+        return std::min<int>(-std::log(u) / std::log((double)M), 31);
+    }
+
+    /** Beam search of the given width on a level of the graph, starting from
+        the given candidates.  Returns up to ef candidates sorted by
+        distance.
+    */
+    template<typename DistanceFn>
+    std::vector<Candidate>
+    searchLevel(const DistanceFn & distance,
+                const std::vector<Candidate> & entry,
+                int ef, int level) const
+    {
+        // Closest unexpanded candidate on top
+        std::priority_queue<Candidate, std::vector<Candidate>,
+                            std::greater<Candidate> > toExpand;
+        // Furthest of the best ef found so far on top
+        std::priority_queue<Candidate> found;
+
+        // Reused between searches so that clearing it is O(1); each thread
+        // needs its own as searches can run concurrently.
+        static thread_local VisitedSet visited;
+        visited.clear(nodes.size() + 1);
+
+        for (auto & e: entry) {
+            if (!visited.insert(e.second))
+                continue;
+            toExpand.push(e);
+            found.push(e);
+        }
+
+        while (found.size() > ef)
+            found.pop();
+
+        while (!toExpand.empty()) {
+            Candidate current = toExpand.top();
+            if (found.size() >= ef && current.first > found.top().first)
+                break;
+            toExpand.pop();
+
+            for (uint32_t n: nodes[current.second].links[level]) {
+                if (!visited.insert(n))
+                    continue;
+                float d = distance(n);
+                if (found.size() < ef || d < found.top().first) {
+                    toExpand.emplace(d, n);
+                    found.emplace(d, n);
+                    if (found.size() > ef)
+                        found.pop();
+                }
+            }
+        }
+
+        std::vector<Candidate> result(found.size());
+        for (size_t i = result.size();  i > 0;  --i) {
+            result[i - 1] = found.top();
+            found.pop();
+        }
+        return result;
+    }
+
+    /** Choose up to m neighbours from the candidates, which are sorted by
+        distance.  A candidate is skipped if it is closer to an already
+        chosen neighbour than to the item itself, which keeps links going
+        in different directions; skipped candidates are used to fill up
+        to m if there aren't enough.
+    */
+    template<typename NodeDistanceFn>
+    std::vector<Candidate>
+    selectNeighbours(const std::vector<Candidate> & candidates, size_t m,
+                     const NodeDistanceFn & nodeDistance) const
+    {
+        if (candidates.size() <= m)
+            return candidates;
+
+        std::vector<Candidate> result, skipped;
+        result.reserve(m);
+
+        for (auto & c: candidates) {
+            if (result.size() == m)
+                break;
+            bool keep = true;
+            for (auto & r: result) {
+                if (nodeDistance(c.second, r.second) < c.first) {
+                    keep = false;
+                    break;
+                }
+            }
+            (keep ? result : skipped).push_back(c);
+        }
+
+        for (size_t i = 0;  i < skipped.size() && result.size() < m;  ++i)
+            result.push_back(skipped[i]);
+
+        return result;
+    }
+};
+
+typedef HnswIndexT<int> HnswIndex;
+
+} // namespace MLDB
@@ -0,0 +1,282 @@
+/* lru_cache.h                                                     -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Thread-safe cache that evicts the least recently used entry.
+*/
+
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <functional>
+#include <memory>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* LRU CACHE STATS                                                           */
+/*****************************************************************************/
+
+/** Statistics about the use of an LruCache. */
+
+struct LruCacheStats {
+    size_t size = 0;        ///< Number of entries currently cached
+    size_t capacity = 0;    ///< Maximum number of entries
+    uint64_t hits = 0;      ///< Lookups that found an entry
+    uint64_t misses = 0;    ///< Lookups that didn't find an entry
+    uint64_t evictions = 0; ///< Entries removed to make space
+};
+
+
+/*****************************************************************************/
+/* LRU CACHE                                                                 */
+/*****************************************************************************/
+
+/** Cache of up to capacity values, which evicts the least recently used
+    entry once it's full.  A capacity of zero disables the cache; nothing
+    is kept and every lookup is a miss.
+
+    Values are returned by copy under a lock, so the value type should be
+    cheap to copy (typically a shared_ptr to an immutable object).  It's
+    safe to use from multiple threads.
+*/
+template<typename Key, typename Value, typename Hash = std::hash<Key> >
+struct LruCache {
+    LruCache(size_t capacity = 0)
+        : capacity_(capacity)
+    {
+    }
+
+    /** Look up the value for the given key.  Returns true and fills in
+        value if it was found, in which case it becomes the most recently
+        used entry.
+    */
+    bool get(const Key & key, Value & value)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            ++stats_.misses;
+            return false;
+        }
+        ++stats_.hits;
+        entries.splice(entries.begin(), entries, it->second);
+        value = it->second->second;
+        return true;
+    }
+
+    /** Insert or replace the value for the given key, making it the most
+        recently used entry and evicting the least recently used one if
+        the cache is full.
+    */
+    void put(const Key & key, Value value)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (capacity_ == 0)
+            return;
+
+        auto it = index.find(key);
+        if (it != index.end()) {
+            it->second->second = std::move(value);
+            entries.splice(entries.begin(), entries, it->second);
+            return;
+        }
+
+        entries.emplace_front(key, std::move(value));
+        index[key] = entries.begin();
+        trim();
+    }
+
+    /** Return the value for the given key, calling create to make it
+        if it's not cached.  create is called without the lock held, so
+        that it can take a long time; if two threads miss at the same time
+        then both will create it and the last one wins.
+    */
+    template<typename Create>
+    Value getOrCreate(const Key & key, Create && create)
+    {
+        Value result;
+        if (get(key, result))
+            return result;
+        result = create();
+        put(key, result);
+        return result;
+    }
+
+    /// Remove the entry for the given key, returning whether it was there
+    bool erase(const Key & key)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = index.find(key);
+        if (it == index.end())
+            return false;
+        entries.erase(it->second);
+        index.erase(it);
+        return true;
+    }
+
+    /// Remove all entries.  The statistics are kept.
+    void clear()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        entries.clear();
+        index.clear();
+    }
+
+    /// Change the capacity, evicting entries if necessary
+    void setCapacity(size_t capacity)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        capacity_ = capacity;
+        trim();
+    }
+
+    size_t capacity() const
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        return capacity_;
+    }
+
+    size_t size() const
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        return entries.size();
+    }
+
+    LruCacheStats stats() const
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        LruCacheStats result = stats_;
+        result.size = entries.size();
+        result.capacity = capacity_;
+        return result;
+    }
+
+private:
+    typedef std::list<std::pair<Key, Value> > Entries;
+
+    mutable std::mutex mutex;
+    size_t capacity_;
+    Entries entries;  ///< Most recently used first
+    std::unordered_map<Key, typename Entries::iterator, Hash> index;
+    LruCacheStats stats_;
+
+    /// Evict entries until we're within capacity.  Mutex must be held.
+    void trim()
+    {
+        while (entries.size() > capacity_) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+            ++stats_.evictions;
+        }
+    }
+};
+
+
+
+/*****************************************************************************/
+/* SHARDED LRU CACHE                                                         */
+/*****************************************************************************/
+
+/** LruCache split into a number of shards by the hash of the key, each
+    with its own lock, so that many threads can use it at once without
+    all contending on the same mutex.  Each shard holds an equal part of
+    the capacity and evicts its own least recently used entries, so the
+    eviction order is only approximately LRU over the whole cache.
+*/
+template<typename Key, typename Value, typename Hash = std::hash<Key> >
+struct ShardedLruCache {
+    typedef LruCache<Key, Value, Hash> Shard;
+
+    ShardedLruCache(size_t capacity = 0, size_t numShards = 16)
+    {
+        if (numShards == 0)
+            numShards = 1;
+        for (size_t i = 0;  i < numShards;  ++i)
+            shards.emplace_back(new Shard());
+        setCapacity(capacity);
+    }
+
+    bool get(const Key & key, Value & value)
+    {
+        return shard(key).get(key, value);
+    }
+
+    void put(const Key & key, Value value)
+    {
+        shard(key).put(key, std::move(value));
+    }
+
+    template<typename Create>
+    Value getOrCreate(const Key & key, Create && create)
+    {
+        return shard(key).getOrCreate(key, std::forward<Create>(create));
+    }
+
+    bool erase(const Key & key)
+    {
+        return shard(key).erase(key);
+    }
+
+    void clear()
+    {
+        for (auto & s: shards)
+            s->clear();
+    }
+
+    /// Change the capacity, which is split evenly over the shards
+    void setCapacity(size_t capacity)
+    {
+        size_t perShard = (capacity + shards.size() - 1) / shards.size();
+        for (auto & s: shards)
+            s->setCapacity(perShard);
+    }
+
+    size_t capacity() const
+    {
+        size_t result = 0;
+        for (auto & s: shards)
+            result += s->capacity();
+        return result;
+    }
+
+    size_t size() const
+    {
+        size_t result = 0;
+        for (auto & s: shards)
+            result += s->size();
+        return result;
+    }
+
+    /// Statistics summed over all of the shards
+    LruCacheStats stats() const
+    {
+        LruCacheStats result;
+        for (auto & s: shards) {
+            LruCacheStats stats = s->stats();
+            result.size += stats.size;
+            result.capacity += stats.capacity;
+            result.hits += stats.hits;
+            result.misses += stats.misses;
+            result.evictions += stats.evictions;
+        }
+        return result;
+    }
+
+private:
+    std::vector<std::unique_ptr<Shard> > shards;
+
+    Shard & shard(const Key & key) const
+    {
+        // Mix the hash, as keys that are already hashes may be poorly
+        // distributed in their low bits
+        uint64_t h = Hash()(key) * 0x9e3779b97f4a7c15ULL;
+        return *shards[(h >> 32) % shards.size()];
+    }
+};
+
+} // namespace MLDB
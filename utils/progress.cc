@@ -94,6 +94,109 @@ operator = (uint64_t count_) {
     return *this;
 }
 
+
+/*****************************************************************************/
+/* PROGRESS COUNTER                                                          */
+/*****************************************************************************/
+
+uint64_t
+ProgressCounter::
+total() const
+{
+    uint64_t result = 0;
+    for (auto & slot: slots)
+        result += slot.count.load(std::memory_order_relaxed);
+    return result;
+}
+
+size_t
+ProgressCounter::
+threadSlot()
+{
+    static std::atomic<size_t> nextSlot(0);
+    static thread_local size_t slot
+        = nextSlot.fetch_add(1, std::memory_order_relaxed) % NUM_SLOTS;
+    return slot;
+}
+
+
+/*****************************************************************************/
+/* PROGRESS REPORTER                                                         */
+/*****************************************************************************/
+
+ProgressReporter::
+ProgressReporter(std::function<uint64_t ()> sample,
+                 std::function<bool (uint64_t)> report,
+                 double intervalSeconds)
+    : sample(std::move(sample)), report(std::move(report)),
+      intervalSeconds(intervalSeconds), lastReported(0), cancelled_(false),
+      shutdown(false)
+{
+    thread = std::thread([this] () { this->run(); });
+}
+
+ProgressReporter::
+~ProgressReporter()
+{
+    stop();
+}
+
+bool
+ProgressReporter::
+finish()
+{
+    stop();
+    if (!cancelled())
+        reportIfChanged();
+    return !cancelled();
+}
+
+void
+ProgressReporter::
+stop()
+{
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        shutdown = true;
+    }
+    cond.notify_all();
+    if (thread.joinable())
+        thread.join();
+}
+
+void
+ProgressReporter::
+run()
+{
+    auto interval = std::chrono::duration<double>(intervalSeconds);
+
+    std::unique_lock<std::mutex> guard(mutex);
+    while (!shutdown) {
+        if (cond.wait_for(guard, interval, [&] () { return shutdown; }))
+            break;
+        guard.unlock();
+        bool keepGoing = reportIfChanged();
+        guard.lock();
+        if (!keepGoing)
+            break;
+    }
+}
+
+bool
+ProgressReporter::
+reportIfChanged()
+{
+    uint64_t value = sample();
+    if (value == lastReported)
+        return true;
+    lastReported = value;
+    if (!report(value)) {
+        cancelled_ = true;
+        return false;
+    }
+    return true;
+}
+
 ConvertProgressToJson::
 ConvertProgressToJson(const std::function<bool(const Json::Value &)> & onJsonProgress)
     : onJsonProgress(onJsonProgress)
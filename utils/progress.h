@@ -10,6 +10,10 @@
 #include <memory>
 #include <vector>
 #include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "mldb/types/date.h"
 #include "mldb/types/optional.h"
@@ -64,6 +68,79 @@ DECLARE_STRUCTURE_DESCRIPTION(ProgressState);
 
 typedef std::function<bool(const ProgressState &)> ProgressFunc;
 
+/** Count of items processed that many threads can add to at once without
+    contending with each other.  Each thread adds to its own cache line
+    with a relaxed atomic, and the slots are only summed when the total is
+    read, which is normally done by a ProgressReporter.
+*/
+struct ProgressCounter {
+    void add(uint64_t n = 1)
+    {
+        slots[threadSlot()].count.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /** Sum over all threads.  It's only exact once they've stopped
+        adding.
+    */
+    uint64_t total() const;
+
+private:
+    static constexpr size_t NUM_SLOTS = 64;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> count{0};
+    };
+
+    Slot slots[NUM_SLOTS];
+
+    /// Slot for this thread; threads are given slots round robin
+    static size_t threadSlot();
+};
+
+/** Reports progress at a fixed interval from its own thread, so that the
+    workers only ever update counters and never build the JSON status or
+    call the (usually locked) progress callback themselves.
+
+    Every interval, sample() is called and, if it has changed since the
+    last time, report() is called with the new value.  If report() returns
+    false the reporter stops and cancelled() becomes true, which the
+    workers can poll to stop early.
+*/
+struct ProgressReporter {
+    ProgressReporter(std::function<uint64_t ()> sample,
+                     std::function<bool (uint64_t)> report,
+                     double intervalSeconds = 0.5);
+
+    /** Stops the reporting thread without a final report. */
+    ~ProgressReporter();
+
+    /** Stops the reporting thread, and reports the final value unless
+        we've been cancelled.  Returns false if cancelled.
+    */
+    bool finish();
+
+    bool cancelled() const
+    {
+        return cancelled_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void stop();
+    void run();
+    bool reportIfChanged();
+
+    std::function<uint64_t ()> sample;
+    std::function<bool (uint64_t)> report;
+    double intervalSeconds;
+    uint64_t lastReported;
+    std::atomic<bool> cancelled_;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool shutdown;
+    std::thread thread;
+};
+
 /* This is a temporary conversion helper to avoid 
    changing all the procedure run signature.
    TODO - MLDB-2110 - fix all the progress signature */
@@ -0,0 +1,890 @@
+/* sketches.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Mergeable sketches of distinct counts, quantiles and frequent values.
+*/
+
+#include "mldb/utils/sketches.h"
+#include "mldb/arch/exception.h"
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+// Serialized sketches start with one of these, which include a version
+static const char HLL_MAGIC[4] = { 'H', 'L', 'L', 1 };
+static const char TDIGEST_MAGIC[4] = { 'T', 'D', 'G', 1 };
+static const char COUNT_MIN_MAGIC[4] = { 'C', 'M', 'S', 1 };
+static const char HEAVY_HITTERS_MAGIC[4] = { 'H', 'H', 'T', 1 };
+static const char KLL_MAGIC[4] = { 'K', 'L', 'L', 1 };
+
+template<typename T>
+void write(std::string & result, const T & val)
+{
+    result.append(reinterpret_cast<const char *>(&val), sizeof(val));
+}
+
+template<typename T>
+T read(const char * & data, const char * end, const char * what)
+{
+    if (end - data < (ssize_t)sizeof(T))
+        throw Exception("Truncated serialized %s sketch", what);
+    T result;
+    memcpy(&result, data, sizeof(T));
+    data += sizeof(T);
+    return result;
+}
+
+bool hasMagic(const char * data, size_t length, const char * magic)
+{
+    return length >= 4 && memcmp(data, magic, 4) == 0;
+}
+
+void readMagic(const char * & data, const char * end, const char * magic,
+               const char * what)
+{
+    if (!hasMagic(data, end - data, magic))
+        throw Exception("Data is not a serialized %s sketch", what);
+    data += 4;
+}
+
+void checkEnd(const char * data, const char * end, const char * what)
+{
+    if (data != end)
+        throw Exception("Extra data at end of serialized %s sketch", what);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* HYPER LOG LOG                                                             */
+/*****************************************************************************/
+
+HyperLogLog::
+HyperLogLog(int precision)
+    : precision_(precision)
+{
+    if (precision < 4 || precision > 18)
+        throw Exception("HyperLogLog precision must be between 4 and 18");
+}
+
+void
+HyperLogLog::
+insertHash(uint64_t hash)
+{
+    // The first bits choose the register, and the number of leading zeros
+    // of the rest plus one is the value to put in it
+    uint32_t bucket = hash >> (64 - precision_);
+    uint64_t rest = hash << precision_;
+    int maxValue = 64 - precision_ + 1;
+    int value = rest == 0 ? maxValue
+        : std::min(__builtin_clzll(rest) + 1, maxValue);
+    setRegister(bucket, value);
+}
+
+void
+HyperLogLog::
+setRegister(uint32_t bucket, uint8_t value)
+{
+    if (!registers.empty()) {
+        if (registers[bucket] < value)
+            registers[bucket] = value;
+        return;
+    }
+
+    uint32_t key = bucket << 8;
+    auto it = std::lower_bound(sparse.begin(), sparse.end(), key);
+    if (it != sparse.end() && (*it >> 8) == bucket) {
+        if ((*it & 0xff) < value)
+            *it = key | value;
+        return;
+    }
+
+    sparse.insert(it, key | value);
+
+    // Once it's a quarter full, the sparse registers take as much space
+    // as the dense ones
+    if (sparse.size() > (1U << precision_) / 4)
+        densify();
+}
+
+void
+HyperLogLog::
+densify()
+{
+    if (!registers.empty())
+        return;
+    registers.resize(1U << precision_);
+    for (uint32_t entry: sparse)
+        registers[entry >> 8] = entry & 0xff;
+    sparse.clear();
+    sparse.shrink_to_fit();
+}
+
+void
+HyperLogLog::
+merge(const HyperLogLog & other)
+{
+    if (other.precision_ != precision_)
+        throw Exception("Can't merge HyperLogLog sketches of precision %d "
+                        "and %d", precision_, other.precision_);
+
+    if (other.registers.empty()) {
+        for (uint32_t entry: other.sparse)
+            setRegister(entry >> 8, entry & 0xff);
+        return;
+    }
+
+    densify();
+    for (size_t i = 0;  i < registers.size();  ++i)
+        registers[i] = std::max(registers[i], other.registers[i]);
+}
+
+double
+HyperLogLog::
+estimate() const
+{
+    // Ertl, "New cardinality estimation algorithms for HyperLogLog
+    // sketches", 2017, which only needs the histogram of register values.
+    double m = 1U << precision_;
+    int q = 64 - precision_;
+
+    std::vector<double> counts(q + 2);
+    if (registers.empty()) {
+        counts[0] = m - sparse.size();
+        for (uint32_t entry: sparse)
+            counts[entry & 0xff] += 1;
+    }
+    else {
+        for (uint8_t r: registers)
+            counts[r] += 1;
+    }
+
+    if (counts[0] == m)
+        return 0.0;
+
+    auto sigma = [] (double x)
+        {
+            double y = 1.0, z = x, prev;
+            do {
+                x *= x;
+                prev = z;
+                z += x * y;
+                y += y;
+            } while (z != prev);
+            return z;
+        };
+
+    auto tau = [] (double x)
+        {
+            if (x == 0.0 || x == 1.0)
+                return 0.0;
+            double y = 1.0, z = 1.0 - x, prev;
+            do {
+                x = sqrt(x);
+                prev = z;
+                y *= 0.5;
+                z -= (1.0 - x) * (1.0 - x) * y;
+            } while (z != prev);
+            return z / 3.0;
+        };
+
+    double z = m * tau(1.0 - counts[q + 1] / m);
+    for (int k = q;  k >= 1;  --k)
+        z = 0.5 * (z + counts[k]);
+    z += m * sigma(counts[0] / m);
+
+    return m * m / (2.0 * log(2.0) * z);
+}
+
+std::string
+HyperLogLog::
+serialize() const
+{
+    std::string result(HLL_MAGIC, 4);
+    write<uint8_t>(result, precision_);
+    write<uint8_t>(result, registers.empty());
+    if (registers.empty()) {
+        write<uint32_t>(result, sparse.size());
+        for (uint32_t entry: sparse)
+            write(result, entry);
+    }
+    else {
+        result.append(reinterpret_cast<const char *>(registers.data()),
+                      registers.size());
+    }
+    return result;
+}
+
+HyperLogLog
+HyperLogLog::
+reconstitute(const char * data, size_t length)
+{
+    const char * end = data + length;
+    readMagic(data, end, HLL_MAGIC, "HyperLogLog");
+    HyperLogLog result(read<uint8_t>(data, end, "HyperLogLog"));
+    bool isSparse = read<uint8_t>(data, end, "HyperLogLog");
+    uint32_t m = 1U << result.precision_;
+    int maxValue = 64 - result.precision_ + 1;
+
+    if (isSparse) {
+        uint32_t n = read<uint32_t>(data, end, "HyperLogLog");
+        if (n > m)
+            throw Exception("Invalid serialized HyperLogLog sketch");
+        result.sparse.reserve(n);
+        for (uint32_t i = 0;  i < n;  ++i) {
+            uint32_t entry = read<uint32_t>(data, end, "HyperLogLog");
+            if ((entry >> 8) >= m || (int)(entry & 0xff) > maxValue
+                || (!result.sparse.empty()
+                    && (entry >> 8) <= (result.sparse.back() >> 8)))
+                throw Exception("Invalid serialized HyperLogLog sketch");
+            result.sparse.push_back(entry);
+        }
+    }
+    else {
+        if (end - data < (ssize_t)m)
+            throw Exception("Truncated serialized HyperLogLog sketch");
+        result.registers.assign(data, data + m);
+        data += m;
+        for (uint8_t r: result.registers)
+            if (r > maxValue)
+                throw Exception("Invalid serialized HyperLogLog sketch");
+    }
+
+    checkEnd(data, end, "HyperLogLog");
+    return result;
+}
+
+bool
+HyperLogLog::
+isSerialized(const char * data, size_t length)
+{
+    return hasMagic(data, length, HLL_MAGIC);
+}
+
+
+/*****************************************************************************/
+/* T DIGEST                                                                  */
+/*****************************************************************************/
+
+TDigest::
+TDigest(double compression)
+    : compression_(compression),
+      min(std::numeric_limits<double>::infinity()),
+      max(-std::numeric_limits<double>::infinity()),
+      totalWeight(0), bufferWeight(0)
+{
+    if (!(compression >= 10 && compression <= 10000))
+        throw Exception("t-digest compression must be between 10 and 10000");
+}
+
+void
+TDigest::
+insert(double value, double weight)
+{
+    if (std::isnan(value) || !(weight > 0))
+        return;
+    buffer.push_back({ value, weight });
+    bufferWeight += weight;
+    min = std::min(min, value);
+    max = std::max(max, value);
+    if (buffer.size() >= 5 * compression_)
+        compress();
+}
+
+void
+TDigest::
+merge(const TDigest & other)
+{
+    for (auto & c: other.centroids)
+        buffer.push_back(c);
+    for (auto & c: other.buffer)
+        buffer.push_back(c);
+    bufferWeight += other.totalWeight + other.bufferWeight;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+    if (buffer.size() >= 5 * compression_)
+        compress();
+}
+
+void
+TDigest::
+compress() const
+{
+    if (buffer.empty())
+        return;
+
+    buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+    std::sort(buffer.begin(), buffer.end());
+
+    double total = totalWeight + bufferWeight;
+
+    // The scale function k1 of the paper, which makes the clusters smaller
+    // towards the tails, and its inverse
+    auto k = [&] (double q)
+        {
+            q = std::min(1.0, std::max(0.0, q));
+            return compression_ / (2 * M_PI) * asin(2 * q - 1);
+        };
+    auto kInverse = [&] (double k)
+        {
+            return (sin(k * 2 * M_PI / compression_) + 1) / 2;
+        };
+
+    std::vector<Centroid> result;
+    double soFar = 0;
+    Centroid current = buffer[0];
+    double limit = total * kInverse(k(0) + 1);
+
+    for (size_t i = 1;  i < buffer.size();  ++i) {
+        const Centroid & c = buffer[i];
+        if (soFar + current.weight + c.weight <= limit) {
+            current.weight += c.weight;
+            current.mean += (c.mean - current.mean) * c.weight / current.weight;
+        }
+        else {
+            soFar += current.weight;
+            result.push_back(current);
+            limit = total * kInverse(k(soFar / total) + 1);
+            current = c;
+        }
+    }
+    result.push_back(current);
+
+    centroids = std::move(result);
+    buffer.clear();
+    totalWeight = total;
+    bufferWeight = 0;
+}
+
+size_t
+TDigest::
+numCentroids() const
+{
+    compress();
+    return centroids.size();
+}
+
+double
+TDigest::
+quantile(double q) const
+{
+    compress();
+
+    if (centroids.empty() || std::isnan(q))
+        return std::nan("");
+    if (q <= 0)
+        return min;
+    if (q >= 1)
+        return max;
+    if (centroids.size() == 1)
+        return min + q * (max - min);
+
+    // Interpolate between the centers of the clusters, and between the
+    // extreme values and the centers of the outer clusters
+    double index = q * totalWeight;
+
+    const Centroid & first = centroids.front();
+    if (index < first.weight / 2)
+        return min + (first.mean - min) * index / (first.weight / 2);
+
+    double center = first.weight / 2;
+    for (size_t i = 0;  i + 1 < centroids.size();  ++i) {
+        const Centroid & c = centroids[i];
+        const Centroid & next = centroids[i + 1];
+        double nextCenter = center + (c.weight + next.weight) / 2;
+        if (index < nextCenter) {
+            double frac = (index - center) / (nextCenter - center);
+            return c.mean + frac * (next.mean - c.mean);
+        }
+        center = nextCenter;
+    }
+
+    const Centroid & last = centroids.back();
+    double frac = std::min(1.0, (index - center) / (last.weight / 2));
+    return last.mean + frac * (max - last.mean);
+}
+
+std::string
+TDigest::
+serialize() const
+{
+    compress();
+
+    std::string result(TDIGEST_MAGIC, 4);
+    write(result, compression_);
+    write(result, min);
+    write(result, max);
+    write<uint32_t>(result, centroids.size());
+    for (auto & c: centroids) {
+        write(result, c.mean);
+        write(result, c.weight);
+    }
+    return result;
+}
+
+TDigest
+TDigest::
+reconstitute(const char * data, size_t length)
+{
+    const char * end = data + length;
+    readMagic(data, end, TDIGEST_MAGIC, "t-digest");
+    TDigest result(read<double>(data, end, "t-digest"));
+    result.min = read<double>(data, end, "t-digest");
+    result.max = read<double>(data, end, "t-digest");
+    uint32_t n = read<uint32_t>(data, end, "t-digest");
+    if ((end - data) / (2 * sizeof(double)) < n)
+        throw Exception("Truncated serialized t-digest sketch");
+    result.centroids.reserve(n);
+    for (uint32_t i = 0;  i < n;  ++i) {
+        Centroid c;
+        c.mean = read<double>(data, end, "t-digest");
+        c.weight = read<double>(data, end, "t-digest");
+        if (!(c.weight > 0)
+            || (!result.centroids.empty()
+                && c.mean < result.centroids.back().mean))
+            throw Exception("Invalid serialized t-digest sketch");
+        result.centroids.push_back(c);
+        result.totalWeight += c.weight;
+    }
+    checkEnd(data, end, "t-digest");
+    return result;
+}
+
+bool
+TDigest::
+isSerialized(const char * data, size_t length)
+{
+    return hasMagic(data, length, TDIGEST_MAGIC);
+}
+
+
+/*****************************************************************************/
+/* KLL SKETCH                                                                */
+/*****************************************************************************/
+
+KllSketch::
+KllSketch(uint32_t k)
+    : k_(k), count_(0), levels(1), randomState(0x9e3779b97f4a7c15ULL)
+{
+    if (k < 8 || k > 65536)
+        throw Exception("KLL sketch k must be between 8 and 65536");
+}
+
+size_t
+KllSketch::
+capacity(size_t level) const
+{
+    // Levels get smaller by a factor of 2/3 going down from the top one
+    size_t depth = levels.size() - level - 1;
+    return std::max<size_t>(2, ceil(k_ * pow(2.0 / 3.0, depth)));
+}
+
+void
+KllSketch::
+insert(double value)
+{
+    if (std::isnan(value))
+        return;
+    levels[0].push_back(value);
+    ++count_;
+    if (levels[0].size() >= capacity(0))
+        compress();
+}
+
+void
+KllSketch::
+merge(const KllSketch & other)
+{
+    if (other.levels.size() > levels.size())
+        levels.resize(other.levels.size());
+    for (size_t i = 0;  i < other.levels.size();  ++i)
+        levels[i].insert(levels[i].end(),
+                         other.levels[i].begin(), other.levels[i].end());
+    count_ += other.count_;
+    compress();
+}
+
+void
+KllSketch::
+compress()
+{
+    for (size_t h = 0;  h < levels.size();  ++h) {
+        if (levels[h].size() < capacity(h))
+            continue;
+        if (h + 1 == levels.size())
+            levels.emplace_back();
+
+        std::vector<double> & level = levels[h];
+        std::vector<double> & next = levels[h + 1];
+        std::sort(level.begin(), level.end());
+
+        // With an odd number, the largest stays behind so that the weight
+        // of what's promoted is the same as what's removed
+        bool keepLast = level.size() % 2;
+
+        // xorshift64
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 7;
+        randomState ^= randomState << 17;
+
+        for (size_t i = randomState & 1;  i + keepLast < level.size();  i += 2)
+            next.push_back(level[i]);
+
+        if (keepLast)
+            level.front() = level.back();
+        level.resize(keepLast);
+    }
+}
+
+size_t
+KllSketch::
+numRetained() const
+{
+    size_t result = 0;
+    for (auto & l: levels)
+        result += l.size();
+    return result;
+}
+
+std::vector<std::pair<double, uint64_t> >
+KllSketch::
+getWeightedValues() const
+{
+    std::vector<std::pair<double, uint64_t> > result;
+    result.reserve(numRetained());
+    for (size_t h = 0;  h < levels.size();  ++h)
+        for (double v: levels[h])
+            result.emplace_back(v, uint64_t(1) << h);
+    std::sort(result.begin(), result.end());
+
+    // Combine equal numbers
+    size_t n = 0;
+    for (size_t i = 0;  i < result.size();  ++i) {
+        if (n > 0 && result[n - 1].first == result[i].first)
+            result[n - 1].second += result[i].second;
+        else result[n++] = result[i];
+    }
+    result.resize(n);
+    return result;
+}
+
+double
+KllSketch::
+quantile(double q) const
+{
+    auto values = getWeightedValues();
+    if (values.empty() || std::isnan(q))
+        return std::nan("");
+
+    double rank = q * count_;
+    uint64_t soFar = 0;
+    for (auto & v: values) {
+        soFar += v.second;
+        if (soFar > rank)
+            return v.first;
+    }
+    return values.back().first;
+}
+
+std::string
+KllSketch::
+serialize() const
+{
+    std::string result(KLL_MAGIC, 4);
+    write(result, k_);
+    write(result, count_);
+    write(result, randomState);
+    write<uint32_t>(result, levels.size());
+    for (auto & l: levels) {
+        write<uint32_t>(result, l.size());
+        for (double v: l)
+            write(result, v);
+    }
+    return result;
+}
+
+KllSketch
+KllSketch::
+reconstitute(const char * data, size_t length)
+{
+    const char * end = data + length;
+    readMagic(data, end, KLL_MAGIC, "KLL");
+    KllSketch result(read<uint32_t>(data, end, "KLL"));
+    result.count_ = read<uint64_t>(data, end, "KLL");
+    result.randomState = read<uint64_t>(data, end, "KLL");
+    uint32_t numLevels = read<uint32_t>(data, end, "KLL");
+    if (numLevels == 0 || numLevels > 64)
+        throw Exception("Invalid serialized KLL sketch");
+    result.levels.resize(numLevels);
+    uint64_t total = 0;
+    for (uint32_t h = 0;  h < numLevels;  ++h) {
+        uint32_t n = read<uint32_t>(data, end, "KLL");
+        if ((end - data) / sizeof(double) < n)
+            throw Exception("Truncated serialized KLL sketch");
+        result.levels[h].reserve(n);
+        for (uint32_t i = 0;  i < n;  ++i)
+            result.levels[h].push_back(read<double>(data, end, "KLL"));
+        total += uint64_t(n) << h;
+    }
+    if (total != result.count_)
+        throw Exception("Invalid serialized KLL sketch");
+    checkEnd(data, end, "KLL");
+    return result;
+}
+
+bool
+KllSketch::
+isSerialized(const char * data, size_t length)
+{
+    return hasMagic(data, length, KLL_MAGIC);
+}
+
+
+/*****************************************************************************/
+/* COUNT MIN SKETCH                                                          */
+/*****************************************************************************/
+
+CountMinSketch::
+CountMinSketch(uint32_t width, uint32_t depth)
+    : width_(width), depth_(depth), total_(0)
+{
+    if (width == 0 || depth == 0 || depth > 32 || width > (1U << 24))
+        throw Exception("Invalid count-min sketch dimensions %d x %d",
+                        width, depth);
+    counts.resize((size_t)width * depth);
+}
+
+// Each row uses a different combination of the two halves of the hash
+// (Kirsch and Mitzenmacher), which is as good as independent hashes.
+static inline uint32_t
+countMinBucket(uint64_t hash, uint32_t row, uint32_t width)
+{
+    uint32_t h1 = hash, h2 = (hash >> 32) | 1;
+    return (h1 + row * h2) % width;
+}
+
+void
+CountMinSketch::
+insertHash(uint64_t hash, uint64_t count)
+{
+    for (uint32_t i = 0;  i < depth_;  ++i)
+        counts[(size_t)i * width_ + countMinBucket(hash, i, width_)] += count;
+    total_ += count;
+}
+
+uint64_t
+CountMinSketch::
+estimateHash(uint64_t hash) const
+{
+    uint64_t result = std::numeric_limits<uint64_t>::max();
+    for (uint32_t i = 0;  i < depth_;  ++i)
+        result = std::min(result,
+                          counts[(size_t)i * width_
+                                 + countMinBucket(hash, i, width_)]);
+    return result;
+}
+
+void
+CountMinSketch::
+merge(const CountMinSketch & other)
+{
+    if (other.width_ != width_ || other.depth_ != depth_)
+        throw Exception("Can't merge count-min sketches of dimensions "
+                        "%d x %d and %d x %d",
+                        width_, depth_, other.width_, other.depth_);
+    for (size_t i = 0;  i < counts.size();  ++i)
+        counts[i] += other.counts[i];
+    total_ += other.total_;
+}
+
+void
+CountMinSketch::
+serializeTo(std::string & result) const
+{
+    write(result, width_);
+    write(result, depth_);
+    write(result, total_);
+    result.append(reinterpret_cast<const char *>(counts.data()),
+                  counts.size() * sizeof(uint64_t));
+}
+
+CountMinSketch
+CountMinSketch::
+reconstituteFrom(const char * & data, const char * end)
+{
+    uint32_t width = read<uint32_t>(data, end, "count-min");
+    uint32_t depth = read<uint32_t>(data, end, "count-min");
+    CountMinSketch result(width, depth);
+    result.total_ = read<uint64_t>(data, end, "count-min");
+    size_t bytes = result.counts.size() * sizeof(uint64_t);
+    if (end - data < (ssize_t)bytes)
+        throw Exception("Truncated serialized count-min sketch");
+    memcpy(result.counts.data(), data, bytes);
+    data += bytes;
+    return result;
+}
+
+std::string
+CountMinSketch::
+serialize() const
+{
+    std::string result(COUNT_MIN_MAGIC, 4);
+    serializeTo(result);
+    return result;
+}
+
+CountMinSketch
+CountMinSketch::
+reconstitute(const char * data, size_t length)
+{
+    const char * end = data + length;
+    readMagic(data, end, COUNT_MIN_MAGIC, "count-min");
+    CountMinSketch result = reconstituteFrom(data, end);
+    checkEnd(data, end, "count-min");
+    return result;
+}
+
+
+/*****************************************************************************/
+/* HEAVY HITTERS                                                             */
+/*****************************************************************************/
+
+HeavyHitters::
+HeavyHitters(uint32_t k, uint32_t width, uint32_t depth)
+    : k_(k), counts(width, depth)
+{
+    if (k == 0 || k > 100000)
+        throw Exception("Number of heavy hitters must be between 1 and "
+                        "100000");
+}
+
+void
+HeavyHitters::
+insert(const std::string & value, uint64_t hash, uint64_t count)
+{
+    counts.insertHash(hash, count);
+    auto it = candidates.find(hash);
+    if (it == candidates.end()) {
+        candidates.emplace(hash, Entry{ value, hash, 0 });
+        if (candidates.size() > 2 * capacity())
+            trim();
+    }
+}
+
+void
+HeavyHitters::
+merge(const HeavyHitters & other)
+{
+    counts.merge(other.counts);
+    for (auto & c: other.candidates)
+        candidates.emplace(c.first, c.second);
+    if (candidates.size() > capacity())
+        trim();
+}
+
+std::vector<HeavyHitters::Entry>
+HeavyHitters::
+sortedCandidates() const
+{
+    std::vector<Entry> result;
+    result.reserve(candidates.size());
+    for (auto & c: candidates) {
+        result.push_back(c.second);
+        result.back().count = counts.estimateHash(c.first);
+    }
+
+    std::sort(result.begin(), result.end(),
+              [] (const Entry & e1, const Entry & e2)
+              {
+                  if (e1.count != e2.count)
+                      return e1.count > e2.count;
+                  return e1.value < e2.value;
+              });
+    return result;
+}
+
+void
+HeavyHitters::
+trim()
+{
+    std::vector<Entry> sorted = sortedCandidates();
+    if (sorted.size() > capacity())
+        sorted.resize(capacity());
+    candidates.clear();
+    for (auto & e: sorted)
+        candidates.emplace(e.hash, std::move(e));
+}
+
+std::vector<HeavyHitters::Entry>
+HeavyHitters::
+top() const
+{
+    std::vector<Entry> result = sortedCandidates();
+    if (result.size() > k_)
+        result.resize(k_);
+    return result;
+}
+
+std::string
+HeavyHitters::
+serialize() const
+{
+    std::string result(HEAVY_HITTERS_MAGIC, 4);
+    write(result, k_);
+    counts.serializeTo(result);
+
+    std::vector<Entry> sorted = sortedCandidates();
+    if (sorted.size() > capacity())
+        sorted.resize(capacity());
+    write<uint32_t>(result, sorted.size());
+    for (auto & e: sorted) {
+        write(result, e.hash);
+        write<uint32_t>(result, e.value.size());
+        result.append(e.value);
+    }
+    return result;
+}
+
+HeavyHitters
+HeavyHitters::
+reconstitute(const char * data, size_t length)
+{
+    const char * end = data + length;
+    readMagic(data, end, HEAVY_HITTERS_MAGIC, "heavy hitters");
+    uint32_t k = read<uint32_t>(data, end, "heavy hitters");
+    CountMinSketch counts = CountMinSketch::reconstituteFrom(data, end);
+    HeavyHitters result(k, counts.width(), counts.depth());
+    result.counts = std::move(counts);
+
+    uint32_t n = read<uint32_t>(data, end, "heavy hitters");
+    for (uint32_t i = 0;  i < n;  ++i) {
+        uint64_t hash = read<uint64_t>(data, end, "heavy hitters");
+        uint32_t len = read<uint32_t>(data, end, "heavy hitters");
+        if (end - data < (ssize_t)len)
+            throw Exception("Truncated serialized heavy hitters sketch");
+        result.candidates.emplace(hash, Entry{ std::string(data, len),
+                                               hash, 0 });
+        data += len;
+    }
+    checkEnd(data, end, "heavy hitters");
+    return result;
+}
+
+bool
+HeavyHitters::
+isSerialized(const char * data, size_t length)
+{
+    return hasMagic(data, length, HEAVY_HITTERS_MAGIC);
+}
+
+} // namespace MLDB
@@ -0,0 +1,307 @@
+/* sketches.h                                                      -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Mergeable sketches that summarize a stream of values in a bounded amount
+   of memory: distinct counts, quantiles and the most frequent values.
+
+   Each sketch can be filled independently (for example, one per thread or
+   per day of data), merged with others of the same kind and serialized
+   to a string of bytes to be stored and merged again later.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HYPER LOG LOG                                                             */
+/*****************************************************************************/
+
+/** Sketch of the number of distinct values, using HyperLogLog with the
+    64 bit hashes and sparse representation of HyperLogLog++.
+
+    Values are added by their hash, which must be well mixed.  Until a
+    quarter of the registers are used, only those that are set are kept,
+    so that sketches of small sets (for example, one per group of a
+    GROUP BY) are small.  The estimate uses Ertl's improved estimator,
+    which is unbiased over the whole range of cardinalities without the
+    empirical bias tables of HyperLogLog++.  The standard error is about
+    1.04 / sqrt(2^precision), which is 0.8% for the default precision.
+*/
+struct HyperLogLog {
+    HyperLogLog(int precision = 14);
+
+    /// Add a value with the given hash
+    void insertHash(uint64_t hash);
+
+    /// Add the values of the other sketch, which must have the same
+    /// precision
+    void merge(const HyperLogLog & other);
+
+    /// Estimate of the number of distinct values added
+    double estimate() const;
+
+    int precision() const { return precision_; }
+
+    /// Is it using the sparse representation?
+    bool isSparse() const { return registers.empty(); }
+
+    std::string serialize() const;
+    static HyperLogLog reconstitute(const char * data, size_t length);
+
+    /// Does the data look like a serialized sketch of this kind?
+    static bool isSerialized(const char * data, size_t length);
+
+private:
+    int precision_;
+
+    /// Dense registers, one per bucket; empty when sparse
+    std::vector<uint8_t> registers;
+
+    /// Sparse registers, sorted, as (bucket << 8) | value
+    std::vector<uint32_t> sparse;
+
+    void setRegister(uint32_t bucket, uint8_t value);
+    void densify();
+};
+
+
+/*****************************************************************************/
+/* T DIGEST                                                                  */
+/*****************************************************************************/
+
+/** Sketch of the distribution of a set of numbers, from which quantiles
+    can be estimated, using the merging t-digest of Dunning.
+
+    The numbers are summarized by at most about compression clusters,
+    which are smaller towards the tails so that extreme quantiles are
+    accurate.  Numbers are buffered and merged into the clusters in
+    batches, so adding one is cheap.
+*/
+struct TDigest {
+    TDigest(double compression = 100);
+
+    /// Add a number, with the given weight
+    void insert(double value, double weight = 1.0);
+
+    /// Add the numbers of the other sketch
+    void merge(const TDigest & other);
+
+    /** Estimate the number below which the given fraction (between 0 and
+        1) of the weight falls.  Returns NaN if nothing was added.
+    */
+    double quantile(double q) const;
+
+    /// Total weight added
+    double weight() const { return totalWeight + bufferWeight; }
+
+    double compression() const { return compression_; }
+
+    /// Number of clusters, once the buffered numbers are merged
+    size_t numCentroids() const;
+
+    std::string serialize() const;
+    static TDigest reconstitute(const char * data, size_t length);
+    static bool isSerialized(const char * data, size_t length);
+
+private:
+    struct Centroid {
+        double mean;
+        double weight;
+        bool operator < (const Centroid & other) const
+        {
+            return mean < other.mean;
+        }
+    };
+
+    double compression_;
+    double min, max;
+
+    // These are mutable so that the buffer can be merged in when a
+    // quantile is asked for
+    mutable std::vector<Centroid> centroids;  ///< Sorted by mean
+    mutable std::vector<Centroid> buffer;     ///< Not yet merged
+    mutable double totalWeight;               ///< Weight of centroids
+    mutable double bufferWeight;              ///< Weight of buffer
+
+    /// Merge the buffered numbers into the clusters
+    void compress() const;
+};
+
+
+/*****************************************************************************/
+/* KLL SKETCH                                                                */
+/*****************************************************************************/
+
+/** Sketch of the distribution of a set of numbers, from which their
+    quantiles can be estimated, using the KLL sketch of Karnin, Lang and
+    Liberty.
+
+    Numbers are kept in a hierarchy of compactors, where each one in level
+    h stands for 2^h of the numbers added.  When a level is full, it's
+    sorted and every other number is promoted to the next level.  The rank
+    error is about 1.7 / k.  Unlike the t-digest, the numbers kept are ones
+    that were added, so that they can be used as split points, and the
+    sketch is exact until the first compaction.
+*/
+struct KllSketch {
+    KllSketch(uint32_t k = 200);
+
+    /// Add a number; NaN is ignored
+    void insert(double value);
+
+    /// Add the numbers of the other sketch
+    void merge(const KllSketch & other);
+
+    /** Estimate the number below which the given fraction (between 0 and
+        1) of the numbers falls.  Returns NaN if nothing was added.
+    */
+    double quantile(double q) const;
+
+    /** Return the numbers that are kept, sorted and without duplicates,
+        each with the number of those that were added that it stands for.
+        The counts add up to count().
+    */
+    std::vector<std::pair<double, uint64_t> > getWeightedValues() const;
+
+    /// Number of numbers added
+    uint64_t count() const { return count_; }
+
+    /// Have all of the numbers added been kept?
+    bool isExact() const { return levels.size() == 1; }
+
+    /// Number of numbers kept
+    size_t numRetained() const;
+
+    uint32_t k() const { return k_; }
+
+    std::string serialize() const;
+    static KllSketch reconstitute(const char * data, size_t length);
+    static bool isSerialized(const char * data, size_t length);
+
+private:
+    uint32_t k_;
+    uint64_t count_;
+    std::vector<std::vector<double> > levels;
+
+    /// State of the generator that picks which half of a level is promoted
+    uint64_t randomState;
+
+    /// Number of numbers that the given level can hold
+    size_t capacity(size_t level) const;
+
+    /// Compact each level that is full into the one above
+    void compress();
+};
+
+
+/*****************************************************************************/
+/* COUNT MIN SKETCH                                                          */
+/*****************************************************************************/
+
+/** Sketch of the number of times each value was seen, which never
+    underestimates and overestimates by at most e / width of the total
+    count with probability 1 - exp(-depth).  Values are added by their
+    hash, which must be well mixed.
+*/
+struct CountMinSketch {
+    CountMinSketch(uint32_t width = 1024, uint32_t depth = 4);
+
+    void insertHash(uint64_t hash, uint64_t count = 1);
+
+    /// Estimate of the number of times the value with the given hash was
+    /// added
+    uint64_t estimateHash(uint64_t hash) const;
+
+    /// Add the counts of the other sketch, which must have the same
+    /// dimensions
+    void merge(const CountMinSketch & other);
+
+    uint32_t width() const { return width_; }
+    uint32_t depth() const { return depth_; }
+
+    /// Total of the counts added
+    uint64_t total() const { return total_; }
+
+    std::string serialize() const;
+    static CountMinSketch reconstitute(const char * data, size_t length);
+
+private:
+    friend struct HeavyHitters;
+
+    uint32_t width_;
+    uint32_t depth_;
+    uint64_t total_;
+    std::vector<uint64_t> counts;  ///< depth rows of width counts
+
+    void serializeTo(std::string & result) const;
+    static CountMinSketch reconstituteFrom(const char * & data,
+                                           const char * end);
+};
+
+
+/*****************************************************************************/
+/* HEAVY HITTERS                                                             */
+/*****************************************************************************/
+
+/** Sketch of the most frequent values of a stream.  The counts are kept
+    in a count-min sketch, and the values that are currently the most
+    frequent are kept as candidates along with them.  Twice as many
+    candidates as asked for are kept, so that values whose count is close
+    to the cutoff aren't lost when sketches are merged.  Candidates are
+    identified by their hash, so two values with the same hash are
+    counted as one.
+*/
+struct HeavyHitters {
+    HeavyHitters(uint32_t k = 10, uint32_t width = 1024, uint32_t depth = 4);
+
+    /// Add a value with the given name and hash
+    void insert(const std::string & value, uint64_t hash, uint64_t count = 1);
+
+    /// Add the values of the other sketch, which must have the same
+    /// count-min dimensions
+    void merge(const HeavyHitters & other);
+
+    struct Entry {
+        std::string value;
+        uint64_t hash;
+        uint64_t count;   ///< Estimated; never an underestimate
+    };
+
+    /// Return the k most frequent values seen, most frequent first
+    std::vector<Entry> top() const;
+
+    uint32_t k() const { return k_; }
+    uint64_t total() const { return counts.total(); }
+
+    std::string serialize() const;
+    static HeavyHitters reconstitute(const char * data, size_t length);
+    static bool isSerialized(const char * data, size_t length);
+
+private:
+    uint32_t k_;
+    CountMinSketch counts;
+
+    /// Candidates, by hash.  They are trimmed back to capacity() once
+    /// there are twice that many, so that adding one is cheap.
+    std::unordered_map<uint64_t, Entry> candidates;
+
+    /// Number of candidates to keep
+    size_t capacity() const { return 2 * k_; }
+
+    /// Return the candidates with up to date counts, most frequent first
+    std::vector<Entry> sortedCandidates() const;
+
+    /// Remove all but the capacity() most frequent candidates
+    void trim();
+};
+
+} // namespace MLDB
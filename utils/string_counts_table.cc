@@ -0,0 +1,363 @@
+/** string_counts_table.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Compact table from strings to a fixed number of counts.
+*/
+
+#include "string_counts_table.h"
+#include "mldb/types/db/persistent.h"
+#include "mldb/types/url.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/ext/cityhash/src/city.h"
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+// The arrays are written in host byte order, and read in place
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "serialized string counts tables are little endian");
+
+
+/*****************************************************************************/
+/* STRING COUNTS TABLE                                                       */
+/*****************************************************************************/
+
+StringCountsTable::
+StringCountsTable(size_t numCounts)
+    : numCounts_(numCounts), numEntries_(0), numSlots_(0),
+      zeros_(numCounts)
+{
+    owned_.offsets.push_back(0);
+}
+
+uint64_t
+StringCountsTable::
+hashKey(const char * key, size_t len)
+{
+    return CityHash64(key, len);
+}
+
+ssize_t
+StringCountsTable::
+findSlot(const char * key, size_t len, uint64_t hash, size_t & slot) const
+{
+    if (numSlots_ == 0)
+        return -1;
+
+    const uint32_t * s = slots();
+    const uint64_t * h = hashes();
+    size_t mask = numSlots_ - 1;
+
+    for (slot = hash & mask;  s[slot];  slot = (slot + 1) & mask) {
+        size_t entry = s[slot] - 1;
+        if (h[entry] == hash && keyLength(entry) == len
+            && std::memcmp(keyData(entry), key, len) == 0)
+            return entry;
+    }
+
+    return -1;
+}
+
+ssize_t
+StringCountsTable::
+find(const char * key, size_t len, uint64_t hash) const
+{
+    size_t slot;
+    return findSlot(key, len, hash, slot);
+}
+
+const int64_t *
+StringCountsTable::
+get(const char * key, size_t len) const
+{
+    ssize_t entry = find(key, len, hashKey(key, len));
+    if (entry == -1)
+        return zeros_.data();
+    return counts(entry);
+}
+
+size_t
+StringCountsTable::
+insertAt(const char * key, size_t len, uint64_t hash, size_t slot)
+{
+    ExcAssert(!mapping_);
+
+    if (numEntries_ >= std::numeric_limits<uint32_t>::max() - 1)
+        throw MLDB::Exception("Too many keys for a string counts table");
+
+    // Keep the load factor at or below one half
+    if ((numEntries_ + 1) * 2 > numSlots_) {
+        rehash(std::max<size_t>(16, numSlots_ * 2));
+        size_t mask = numSlots_ - 1;
+        for (slot = hash & mask;  owned_.slots[slot];  slot = (slot + 1) & mask)
+            ;
+    }
+
+    size_t entry = numEntries_++;
+    owned_.keys.insert(owned_.keys.end(), key, key + len);
+    owned_.offsets.push_back(owned_.keys.size());
+    owned_.hashes.push_back(hash);
+    owned_.counts.resize(owned_.counts.size() + numCounts_);
+    owned_.slots[slot] = entry + 1;
+
+    return entry;
+}
+
+void
+StringCountsTable::
+rehash(size_t newNumSlots)
+{
+    ExcAssert(!mapping_);
+    ExcAssertEqual((newNumSlots & (newNumSlots - 1)), 0);
+
+    numSlots_ = newNumSlots;
+    owned_.slots.clear();
+    owned_.slots.resize(numSlots_);
+
+    size_t mask = numSlots_ - 1;
+    for (size_t i = 0;  i < numEntries_;  ++i) {
+        size_t slot = owned_.hashes[i] & mask;
+        while (owned_.slots[slot])
+            slot = (slot + 1) & mask;
+        owned_.slots[slot] = i + 1;
+    }
+}
+
+int64_t *
+StringCountsTable::
+insert(const char * key, size_t len, uint64_t hash)
+{
+    size_t slot;
+    ssize_t entry = findSlot(key, len, hash, slot);
+    if (entry == -1)
+        entry = insertAt(key, len, hash, slot);
+
+    return owned_.counts.data() + entry * numCounts_;
+}
+
+void
+StringCountsTable::
+add(const char * key, size_t len, uint64_t hash, const int64_t * counts)
+{
+    int64_t * c = insert(key, len, hash);
+    for (size_t i = 0;  i < numCounts_;  ++i)
+        c[i] += counts[i];
+}
+
+void
+StringCountsTable::
+appendDisjoint(const StringCountsTable & other)
+{
+    ExcAssert(!mapping_);
+    ExcAssertEqual(other.numCounts_, numCounts_);
+
+    size_t newNumEntries = numEntries_ + other.numEntries_;
+    if (newNumEntries * 2 > numSlots_) {
+        size_t newNumSlots = std::max<size_t>(16, numSlots_);
+        while (newNumEntries * 2 > newNumSlots)
+            newNumSlots *= 2;
+        rehash(newNumSlots);
+    }
+
+    uint64_t keyBase = owned_.keys.size();
+    owned_.keys.insert(owned_.keys.end(), other.keys(),
+                       other.keys() + other.offsets()[other.numEntries_]);
+    for (size_t i = 1;  i <= other.numEntries_;  ++i)
+        owned_.offsets.push_back(keyBase + other.offsets()[i]);
+    owned_.hashes.insert(owned_.hashes.end(), other.hashes(),
+                         other.hashes() + other.numEntries_);
+    owned_.counts.insert(owned_.counts.end(), other.countData(),
+                         other.countData()
+                         + other.numEntries_ * numCounts_);
+
+    size_t mask = numSlots_ - 1;
+    for (size_t i = numEntries_;  i < newNumEntries;  ++i) {
+        size_t slot = owned_.hashes[i] & mask;
+        while (owned_.slots[slot])
+            slot = (slot + 1) & mask;
+        owned_.slots[slot] = i + 1;
+    }
+
+    numEntries_ = newNumEntries;
+}
+
+StringCountsTable
+StringCountsTable::
+merge(const std::vector<const StringCountsTable *> & tables,
+      size_t numCounts)
+{
+    if (tables.size() == 1) {
+        StringCountsTable result(numCounts);
+        result.appendDisjoint(*tables[0]);
+        return result;
+    }
+
+    // The top bits of the hash choose the partition, which leaves the
+    // bottom bits (which choose the slot) evenly distributed within each
+    // partition.
+    static constexpr int PARTITION_BITS = 6;
+    static constexpr size_t NUM_PARTITIONS = 1 << PARTITION_BITS;
+
+    // Find which entries of each table belong to each partition
+    std::vector<std::vector<std::vector<uint32_t> > >
+        entries(tables.size(),
+                std::vector<std::vector<uint32_t> >(NUM_PARTITIONS));
+
+    auto splitTable = [&] (size_t t)
+        {
+            const StringCountsTable & table = *tables[t];
+            ExcAssertEqual(table.numCounts_, numCounts);
+            for (size_t i = 0;  i < table.numEntries_;  ++i) {
+                entries[t][table.hash(i) >> (64 - PARTITION_BITS)]
+                    .push_back(i);
+            }
+        };
+
+    parallelMap(0, tables.size(), splitTable);
+
+    // Each partition has its own keys, so they are summed independently
+    std::vector<StringCountsTable>
+        partitions(NUM_PARTITIONS, StringCountsTable(numCounts));
+
+    auto mergePartition = [&] (size_t p)
+        {
+            StringCountsTable & partition = partitions[p];
+            for (size_t t = 0;  t < tables.size();  ++t) {
+                const StringCountsTable & table = *tables[t];
+                for (uint32_t i: entries[t][p]) {
+                    partition.add(table.keyData(i), table.keyLength(i),
+                                  table.hash(i), table.counts(i));
+                }
+                std::vector<uint32_t>().swap(entries[t][p]);
+            }
+        };
+
+    parallelMap(0, NUM_PARTITIONS, mergePartition);
+
+    // Finally, concatenate them, sizing the result up front
+    size_t numEntries = 0, numKeyBytes = 0;
+    for (auto & p: partitions) {
+        numEntries += p.numEntries_;
+        numKeyBytes += p.owned_.keys.size();
+    }
+
+    StringCountsTable result(numCounts);
+    result.owned_.keys.reserve(numKeyBytes);
+    result.owned_.offsets.reserve(numEntries + 1);
+    result.owned_.hashes.reserve(numEntries);
+    result.owned_.counts.reserve(numEntries * numCounts);
+
+    for (auto & p: partitions) {
+        result.appendDisjoint(p);
+        p = StringCountsTable(numCounts);
+    }
+
+    return result;
+}
+
+void
+StringCountsTable::
+serialize(MLDB::DB::Store_Writer & store) const
+{
+    uint64_t numKeyBytes = offsets()[numEntries_];
+    store << uint64_t(numCounts_) << uint64_t(numEntries_)
+          << uint64_t(numSlots_) << numKeyBytes;
+
+    // Align the arrays relative to the start of the file, so that they
+    // are aligned when it's memory mapped
+    static const char padding[8] = { 0 };
+    store.save_binary(padding, (8 - store.offset() % 8) % 8);
+
+    store.save_binary(offsets(), (numEntries_ + 1) * sizeof(uint64_t));
+    store.save_binary(hashes(), numEntries_ * sizeof(uint64_t));
+    store.save_binary(countData(),
+                      numEntries_ * numCounts_ * sizeof(int64_t));
+    store.save_binary(slots(), numSlots_ * sizeof(uint32_t));
+    store.save_binary(keys(), numKeyBytes);
+}
+
+void
+StringCountsTable::
+reconstitute(MLDB::DB::Store_Reader & store,
+             std::shared_ptr<const void> mapping)
+{
+    uint64_t numCounts, numEntries, numSlots, numKeyBytes;
+    store >> numCounts >> numEntries >> numSlots >> numKeyBytes;
+
+    if ((numSlots & (numSlots - 1)) != 0 || numEntries * 2 > numSlots)
+        throw MLDB::Exception("String counts table is corrupt");
+
+    store.skip((8 - store.offset() % 8) % 8);
+
+    size_t offsetBytes = (numEntries + 1) * sizeof(uint64_t);
+    size_t hashBytes = numEntries * sizeof(uint64_t);
+    size_t countBytes = numEntries * numCounts * sizeof(int64_t);
+    size_t slotBytes = numSlots * sizeof(uint32_t);
+    size_t totalBytes
+        = offsetBytes + hashBytes + countBytes + slotBytes + numKeyBytes;
+
+    StringCountsTable result(numCounts);
+    result.numEntries_ = numEntries;
+    result.numSlots_ = numSlots;
+
+    if (mapping && store.must_have(totalBytes) >= totalBytes
+        && (uintptr_t)store.pos() % alignof(uint64_t) == 0) {
+        const char * p = store.pos();
+        result.mapped_.offsets = (const uint64_t *)p;   p += offsetBytes;
+        result.mapped_.hashes = (const uint64_t *)p;    p += hashBytes;
+        result.mapped_.counts = (const int64_t *)p;     p += countBytes;
+        result.mapped_.slots = (const uint32_t *)p;     p += slotBytes;
+        result.mapped_.keys = p;
+        result.mapping_ = std::move(mapping);
+        store.skip(totalBytes);
+    }
+    else {
+        result.owned_.offsets.resize(numEntries + 1);
+        result.owned_.hashes.resize(numEntries);
+        result.owned_.counts.resize(numEntries * numCounts);
+        result.owned_.slots.resize(numSlots);
+        result.owned_.keys.resize(numKeyBytes);
+        store.load_binary(result.owned_.offsets.data(), offsetBytes);
+        store.load_binary(result.owned_.hashes.data(), hashBytes);
+        store.load_binary(result.owned_.counts.data(), countBytes);
+        store.load_binary(result.owned_.slots.data(), slotBytes);
+        store.load_binary(result.owned_.keys.data(), numKeyBytes);
+    }
+
+    if (result.offsets()[numEntries] != numKeyBytes)
+        throw MLDB::Exception("String counts table is corrupt");
+
+    *this = std::move(result);
+}
+
+std::shared_ptr<const void>
+openStringCountsTableFile(const Url & url, MLDB::DB::Store_Reader & store)
+{
+    auto stream = std::make_shared<filter_istream>
+        (url, std::map<std::string, std::string>{ { "mapped", "true" } });
+
+    const char * mappedAddr;
+    size_t mappedSize;
+    std::tie(mappedAddr, mappedSize) = stream->mapped();
+
+    if (mappedAddr) {
+        store.open(mappedAddr, mappedSize);
+        return stream;
+    }
+
+    std::ostringstream streamo;
+    streamo << stream->rdbuf();
+    auto data = std::make_shared<std::string>(streamo.str());
+    store.open(data->data(), data->size());
+    return data;
+}
+
+} // namespace MLDB
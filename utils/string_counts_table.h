@@ -0,0 +1,182 @@
+/** string_counts_table.h                                           -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Compact table from strings to a fixed number of counts, which can be
+    used in place from a memory mapped file.
+*/
+
+#pragma once
+
+#include "mldb/types/db/persistent_fwd.h"
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <sys/types.h>
+
+namespace MLDB {
+
+struct Url;
+
+
+/*****************************************************************************/
+/* STRING COUNTS TABLE                                                       */
+/*****************************************************************************/
+
+/** Open addressing hash table from a string key to a fixed number of 64 bit
+    counts.
+
+    Keys are stored back to back in a single character buffer and the counts
+    in a single flat array, indexed by entry number; the hash table itself
+    is an array of 32 bit entry numbers with linear probing.  A table with
+    many millions of keys is thus a handful of allocations, and the
+    serialized form is the same arrays, which can be used in place from a
+    memory mapped file.
+
+    Tables that were loaded in place are read-only.
+*/
+
+struct StringCountsTable {
+
+    StringCountsTable(size_t numCounts = 1);
+
+    /// Hash function for keys.  This is part of the serialized form and so
+    /// must never change.
+    static uint64_t hashKey(const char * key, size_t len);
+
+    /** Return the counts for the key, inserting it with zero counts if
+        it's not there.  The pointer is valid until the next insertion.
+    */
+    int64_t * insert(const char * key, size_t len, uint64_t hash);
+
+    /// Add the given counts to those of the key, inserting it if necessary
+    void add(const char * key, size_t len, uint64_t hash,
+             const int64_t * counts);
+
+    /// Return the entry number of the key, or -1 if it's not there
+    ssize_t find(const char * key, size_t len, uint64_t hash) const;
+
+    /// Return the counts of the key, or all zeros if it's not there
+    const int64_t * get(const char * key, size_t len) const;
+
+    size_t size() const { return numEntries_; }
+    size_t numCounts() const { return numCounts_; }
+
+    const char * keyData(size_t entry) const
+    {
+        return keys() + offsets()[entry];
+    }
+
+    size_t keyLength(size_t entry) const
+    {
+        return offsets()[entry + 1] - offsets()[entry];
+    }
+
+    uint64_t hash(size_t entry) const { return hashes()[entry]; }
+
+    const int64_t * counts(size_t entry) const
+    {
+        return countData() + entry * numCounts_;
+    }
+
+    /** Sum the given tables, which must all have the same number of counts,
+        into a single table.  The entries are partitioned by the top bits
+        of their hash so that the partitions are merged in parallel.  The
+        entry order of the result is not defined.
+    */
+    static StringCountsTable
+    merge(const std::vector<const StringCountsTable *> & tables,
+          size_t numCounts);
+
+    /// Is this table used in place from memory that it doesn't own?
+    bool isMapped() const { return !!mapping_; }
+
+    void serialize(MLDB::DB::Store_Writer & store) const;
+
+    /** Reconstitute from the store.  If mapping is non-null, it must
+        keep alive the memory that the store is reading from, and the
+        arrays will be used in place rather than copied where their
+        alignment allows it.
+    */
+    void reconstitute(MLDB::DB::Store_Reader & store,
+                      std::shared_ptr<const void> mapping = nullptr);
+
+private:
+    size_t numCounts_;
+    size_t numEntries_;
+    size_t numSlots_;   ///< Always zero or a power of two
+
+    /// Storage for tables that are built in memory
+    struct Owned {
+        std::vector<char> keys;
+        std::vector<uint64_t> offsets;  ///< numEntries + 1 key offsets
+        std::vector<uint64_t> hashes;
+        std::vector<int64_t> counts;
+        std::vector<uint32_t> slots;    ///< Entry number + 1, or 0 if empty
+    } owned_;
+
+    /// Storage for tables used in place, kept alive by mapping_
+    struct Mapped {
+        const char * keys = nullptr;
+        const uint64_t * offsets = nullptr;
+        const uint64_t * hashes = nullptr;
+        const int64_t * counts = nullptr;
+        const uint32_t * slots = nullptr;
+    } mapped_;
+
+    std::shared_ptr<const void> mapping_;
+
+    /// Returned for keys that aren't in the table
+    std::vector<int64_t> zeros_;
+
+    const char * keys() const
+    {
+        return mapping_ ? mapped_.keys : owned_.keys.data();
+    }
+
+    const uint64_t * offsets() const
+    {
+        return mapping_ ? mapped_.offsets : owned_.offsets.data();
+    }
+
+    const uint64_t * hashes() const
+    {
+        return mapping_ ? mapped_.hashes : owned_.hashes.data();
+    }
+
+    const int64_t * countData() const
+    {
+        return mapping_ ? mapped_.counts : owned_.counts.data();
+    }
+
+    const uint32_t * slots() const
+    {
+        return mapping_ ? mapped_.slots : owned_.slots.data();
+    }
+
+    /// Find the key, returning the entry number or -1, and the slot where
+    /// it is or should be inserted.
+    ssize_t findSlot(const char * key, size_t len, uint64_t hash,
+                     size_t & slot) const;
+
+    /// Insert a new key with zero counts into the given slot
+    size_t insertAt(const char * key, size_t len, uint64_t hash, size_t slot);
+
+    /// Rebuild the slot array with the given (power of two) number of slots
+    void rehash(size_t newNumSlots);
+
+    /// Append all of the entries of the other table, which must not have
+    /// any keys in common with this one.
+    void appendDisjoint(const StringCountsTable & other);
+};
+
+
+/** Open a file containing serialized string counts tables for reading
+    into the store.  Uncompressed local files are memory mapped so that
+    their tables can be used in place; anything else is read into memory.
+    The returned object keeps the memory that the store reads from alive,
+    and should be passed to StringCountsTable::reconstitute().
+*/
+std::shared_ptr<const void>
+openStringCountsTableFile(const Url & url, MLDB::DB::Store_Reader & store);
+
+} // namespace MLDB
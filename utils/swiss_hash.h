@@ -0,0 +1,808 @@
+/* swiss_hash.h                                                    -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Open addressing hash map and set whose slots are found through a separate
+   array of one byte control values, sixteen of which are compared at once.
+   They have the same interface as LightweightHash and LightweightHash_Set,
+   plus erasure.
+*/
+
+#pragma once
+
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include <boost/iterator/iterator_facade.hpp>
+#include <iostream>
+#include <functional>
+#include <utility>
+#include <type_traits>
+#include <new>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SWISS GROUP                                                               */
+/*****************************************************************************/
+
+/** A group of sixteen control bytes, one per slot.  A full slot holds
+    seven bits of its key's hash (so is positive); empty and deleted slots
+    are marked with negative values.  Each of the match functions returns a
+    bitmask with bit i set if control byte i matches.
+*/
+
+struct SwissGroup {
+    static constexpr int WIDTH = 16;
+    static constexpr int8_t EMPTY = -128;
+    static constexpr int8_t DELETED = -2;
+
+    /// Control bytes must be aligned on a 16 byte boundary
+    explicit SwissGroup(const int8_t * ctrl)
+#if defined(__SSE2__)
+        : ctrl(_mm_load_si128(reinterpret_cast<const __m128i *>(ctrl)))
+#else
+        : ctrl(ctrl)
+#endif
+    {
+    }
+
+    /// Slots whose control byte holds the given hash bits
+    uint32_t match(int8_t h2) const
+    {
+#if defined(__SSE2__)
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+#else
+        return matchScalar([=] (int8_t c) { return c == h2; });
+#endif
+    }
+
+    uint32_t matchEmpty() const
+    {
+        return match(EMPTY);
+    }
+
+    /// Empty or deleted slots are exactly those with the high bit set
+    uint32_t matchEmptyOrDeleted() const
+    {
+#if defined(__SSE2__)
+        return _mm_movemask_epi8(ctrl);
+#else
+        return matchScalar([] (int8_t c) { return c < 0; });
+#endif
+    }
+
+    uint32_t matchFull() const
+    {
+        return ~matchEmptyOrDeleted() & 0xffff;
+    }
+
+private:
+#if defined(__SSE2__)
+    __m128i ctrl;
+#else
+    const int8_t * ctrl;
+
+    template<typename Fn>
+    uint32_t matchScalar(Fn && fn) const
+    {
+        uint32_t result = 0;
+        for (int i = 0;  i < WIDTH;  ++i)
+            result |= uint32_t(fn(ctrl[i])) << i;
+        return result;
+    }
+#endif
+};
+
+
+/*****************************************************************************/
+/* SWISS HASH FUNCTION                                                       */
+/*****************************************************************************/
+
+/** Default hash function for a SwissHash.  The table takes its position
+    from the high bits of the hash, so the std::hash value (which for
+    integers is the integer itself) is multiplied by 2^64 divided by the
+    golden ratio to bring entropy from every bit up to the top.
+*/
+
+template<typename Key>
+struct SwissHashFn {
+    uint64_t operator () (const Key & key) const
+    {
+        return uint64_t(std::hash<Key>()(key)) * 0x9e3779b97f4a7c15ULL;
+    }
+};
+
+
+/*****************************************************************************/
+/* SWISS HASH ITERATOR                                                       */
+/*****************************************************************************/
+
+/** Iterator over a SwissHash or SwissHash_Set.  It holds the index of a
+    full slot, or the capacity of the table when at the end.
+*/
+
+template<class Table, class ValueRef>
+class SwissHashIterator
+    : public boost::iterator_facade<SwissHashIterator<Table, ValueRef>,
+                                    ValueRef,
+                                    boost::bidirectional_traversal_tag> {
+public:
+    SwissHashIterator()
+        : table(nullptr), index(0)
+    {
+    }
+
+    /// Iterator at the first full slot at or after index
+    SwissHashIterator(Table * table, ssize_t index)
+        : table(table), index(table->advance_to_valid(index))
+    {
+    }
+
+    template<class T2, class V2>
+    SwissHashIterator(const SwissHashIterator<T2, V2> & other)
+        : table(other.table), index(other.index)
+    {
+    }
+
+    std::string print() const
+    {
+        return format("SwissHashIterator: hash %p index %d",
+                      table, (int)index);
+    }
+
+    Table * table;
+    ssize_t index;
+
+private:
+    friend class boost::iterator_core_access;
+
+    template<class T2, class V2>
+    bool equal(const SwissHashIterator<T2, V2> & other) const
+    {
+        if (table != other.table)
+            throw Exception("comparing incompatible iterators");
+        return index == other.index;
+    }
+
+    ValueRef & dereference() const
+    {
+        if (!table)
+            throw Exception("dereferencing null iterator");
+        return table->dereference(index);
+    }
+
+    void increment()
+    {
+        if (index == table->capacity())
+            throw Exception("increment past the end");
+        index = table->advance_to_valid(index + 1);
+    }
+
+    void decrement()
+    {
+        index = table->backup_to_valid(index - 1);
+    }
+
+    template<class T2, class V2>
+    friend class SwissHashIterator;
+};
+
+template<class Table, class ValueRef>
+std::ostream &
+operator << (std::ostream & stream,
+             const SwissHashIterator<Table, ValueRef> & it)
+{
+    return stream << it.print();
+}
+
+
+/*****************************************************************************/
+/* SWISS HASH BASE                                                           */
+/*****************************************************************************/
+
+/** Table shared by SwissHash and SwissHash_Set.
+
+    The capacity is a power of two multiple of sixteen, and the slots are
+    split into aligned groups of sixteen.  A key's hash chooses its home
+    group from its high bits, and the seven bits below those are stored in
+    the control byte of the slot that holds it, so that a lookup compares
+    the key against only those slots of a group whose control byte matches.
+    Groups are probed in order from the home group until one with an empty
+    slot is found.  As the home group comes from the high bits, keys that
+    are close together end up close together in the table, which keeps
+    insertion of sorted keys and iteration cache friendly.
+
+    Erasing a key from a group that has an empty slot can't break any probe
+    sequence, since none can have gone past that group, so the slot is
+    simply emptied; otherwise it is marked as deleted.  Deleted slots are
+    reused by insertions and cleared when the table is rehashed.
+
+    The table is grown to keep it at most 7/8 full (counting deleted
+    slots).  reserve(n) makes room for n keys without rehashing.
+*/
+
+template<class Key, class Slot, class KeyOf, class Hash>
+struct SwissHashBase {
+
+    SwissHashBase()
+        : ctrl_(nullptr), slots_(nullptr), capacity_(0), size_(0),
+          growthLeft_(0), groupBits_(0)
+    {
+    }
+
+    SwissHashBase(const SwissHashBase & other)
+        : SwissHashBase()
+    {
+        if (other.size_ == 0)
+            return;
+        allocate(other.capacity_);
+        for (ssize_t i = 0;  i < other.capacity_;  ++i) {
+            if (other.ctrl_[i] >= 0)
+                insertUnique(other.slots_[i]);
+        }
+    }
+
+    SwissHashBase(SwissHashBase && other)
+        : SwissHashBase()
+    {
+        swap(other);
+    }
+
+    ~SwissHashBase()
+    {
+        destroy();
+    }
+
+    SwissHashBase & operator = (const SwissHashBase & other)
+    {
+        SwissHashBase new_me(other);
+        swap(new_me);
+        return *this;
+    }
+
+    SwissHashBase & operator = (SwissHashBase && other)
+    {
+        SwissHashBase new_me(std::move(other));
+        swap(new_me);
+        return *this;
+    }
+
+    void swap(SwissHashBase & other)
+    {
+        std::swap(ctrl_, other.ctrl_);
+        std::swap(slots_, other.slots_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(size_, other.size_);
+        std::swap(growthLeft_, other.growthLeft_);
+        std::swap(groupBits_, other.groupBits_);
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    ssize_t capacity() const { return capacity_; }
+
+    /** Remove all keys, keeping the memory. */
+    void clear()
+    {
+        for (ssize_t i = 0;  i < capacity_;  ++i) {
+            if (ctrl_[i] >= 0)
+                slots_[i].~Slot();
+        }
+        if (capacity_)
+            std::memset(ctrl_, SwissGroup::EMPTY, capacity_);
+        size_ = 0;
+        growthLeft_ = maxLoad(capacity_);
+    }
+
+    /** Remove all keys and free the memory. */
+    void destroy()
+    {
+        clear();
+        ::operator delete(ctrl_, std::align_val_t(ALIGNMENT));
+        ctrl_ = nullptr;
+        slots_ = nullptr;
+        capacity_ = 0;
+        growthLeft_ = 0;
+        groupBits_ = 0;
+    }
+
+    bool count(const Key & key) const
+    {
+        return find_full_bucket(key) != NO_BUCKET;
+    }
+
+    /** Make sure that n keys can be held without a rehash. */
+    void reserve(size_t n)
+    {
+        if (n <= size_ + growthLeft_)
+            return;
+        rehash(capacityFor(n));
+    }
+
+    /** Remove the key, returning the number of keys removed. */
+    size_t erase(const Key & key)
+    {
+        ssize_t index = find_full_bucket(key);
+        if (index == NO_BUCKET)
+            return 0;
+        eraseAt(index);
+        return 1;
+    }
+
+    void dump(std::ostream & stream) const
+    {
+        stream << "SwissHash: " << this << " size " << size_ << " capacity "
+               << capacity_ << " growthLeft " << growthLeft_ << std::endl;
+        for (ssize_t i = 0;  i < capacity_;  ++i) {
+            stream << "  slot " << i << ": ctrl " << (int)ctrl_[i];
+            if (ctrl_[i] >= 0)
+                stream << " key " << KeyOf::get(slots_[i]);
+            stream << std::endl;
+        }
+    }
+
+    enum {
+        NO_BUCKET = -1
+    };
+
+protected:
+    static constexpr size_t ALIGNMENT
+        = alignof(Slot) > SwissGroup::WIDTH ? alignof(Slot) : SwissGroup::WIDTH;
+
+    int8_t * ctrl_;        ///< One control byte per slot
+    Slot * slots_;         ///< Slots, constructed only where ctrl_ is full
+    ssize_t capacity_;     ///< Number of slots; zero or a multiple of WIDTH
+    size_t size_;          ///< Number of full slots
+    size_t growthLeft_;    ///< Empty slots that can be filled before a rehash
+    int groupBits_;        ///< log2 of the number of groups
+
+    static size_t maxLoad(size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    static size_t capacityFor(size_t n)
+    {
+        size_t result = SwissGroup::WIDTH;
+        while (maxLoad(result) < n)
+            result *= 2;
+        return result;
+    }
+
+    size_t homeGroup(uint64_t hash) const
+    {
+        return groupBits_ == 0 ? 0 : hash >> (64 - groupBits_);
+    }
+
+    int8_t h2(uint64_t hash) const
+    {
+        return (hash >> (64 - 7 - groupBits_)) & 0x7f;
+    }
+
+    size_t numGroups() const
+    {
+        return capacity_ / SwissGroup::WIDTH;
+    }
+
+    /** Allocate empty storage for the given capacity, which must be a
+        power of two multiple of the group width.  Any existing storage
+        must already have been released.
+    */
+    void allocate(ssize_t capacity)
+    {
+        size_t slotOffset = (capacity + alignof(Slot) - 1)
+            / alignof(Slot) * alignof(Slot);
+        void * mem = ::operator new(slotOffset + capacity * sizeof(Slot),
+                                    std::align_val_t(ALIGNMENT));
+        ctrl_ = reinterpret_cast<int8_t *>(mem);
+        slots_ = reinterpret_cast<Slot *>(reinterpret_cast<char *>(mem)
+                                          + slotOffset);
+        std::memset(ctrl_, SwissGroup::EMPTY, capacity);
+        capacity_ = capacity;
+        size_ = 0;
+        growthLeft_ = maxLoad(capacity);
+        groupBits_ = 0;
+        while ((SwissGroup::WIDTH << groupBits_) < capacity)
+            ++groupBits_;
+    }
+
+    /** Move everything into a fresh table of the given capacity, which also
+        clears out any deleted slots.
+    */
+    void rehash(ssize_t newCapacity)
+    {
+        ExcAssertGreaterEqual(maxLoad(newCapacity), size_);
+
+        SwissHashBase new_me;
+        new_me.allocate(newCapacity);
+        for (ssize_t i = 0;  i < capacity_;  ++i) {
+            if (ctrl_[i] >= 0)
+                new_me.insertUnique(std::move(slots_[i]));
+        }
+        swap(new_me);
+    }
+
+    /** Index of the slot holding key, or NO_BUCKET. */
+    ssize_t find_full_bucket(const Key & key) const
+    {
+        if (capacity_ == 0)
+            return NO_BUCKET;
+
+        uint64_t hash = Hash()(key);
+        int8_t tag = h2(hash);
+        size_t mask = numGroups() - 1;
+        size_t group = homeGroup(hash);
+
+        for (size_t probes = 0;  probes <= mask;  ++probes) {
+            const int8_t * ctrl = ctrl_ + group * SwissGroup::WIDTH;
+            SwissGroup g(ctrl);
+            for (uint32_t m = g.match(tag);  m;  m &= m - 1) {
+                ssize_t index = group * SwissGroup::WIDTH + __builtin_ctz(m);
+                if (KeyOf::get(slots_[index]) == key)
+                    return index;
+            }
+            if (g.matchEmpty())
+                return NO_BUCKET;
+            group = (group + 1) & mask;
+        }
+
+        return NO_BUCKET;
+    }
+
+    /** Index of the first empty or deleted slot in key's probe sequence. */
+    ssize_t find_free_bucket(uint64_t hash) const
+    {
+        size_t mask = numGroups() - 1;
+        size_t group = homeGroup(hash);
+
+        for (size_t probes = 0;  probes <= mask;  ++probes) {
+            SwissGroup g(ctrl_ + group * SwissGroup::WIDTH);
+            uint32_t m = g.matchEmptyOrDeleted();
+            if (m)
+                return group * SwissGroup::WIDTH + __builtin_ctz(m);
+            group = (group + 1) & mask;
+        }
+
+        throw Exception("SwissHash: no free slot in table");
+    }
+
+    /** Put a slot that's known not to be in the table into it, growing it
+        if need be.  Returns the index at which it was put.
+    */
+    template<typename SlotArg>
+    ssize_t insertUnique(SlotArg && slot)
+    {
+        uint64_t hash = Hash()(KeyOf::get(slot));
+
+        if (capacity_ == 0)
+            allocate(SwissGroup::WIDTH);
+
+        ssize_t index = find_free_bucket(hash);
+        if (growthLeft_ == 0 && ctrl_[index] == SwissGroup::EMPTY) {
+            // If at least half of the load is tombstones, we can get rid of
+            // them without growing
+            if (size_ + 1 <= maxLoad(capacity_) / 2)
+                rehash(capacity_);
+            else rehash(capacity_ * 2);
+            index = find_free_bucket(hash);
+        }
+
+        new (slots_ + index) Slot(std::forward<SlotArg>(slot));
+        if (ctrl_[index] == SwissGroup::EMPTY)
+            --growthLeft_;
+        ctrl_[index] = h2(hash);
+        ++size_;
+        return index;
+    }
+
+    /** Returns the index of the key's slot and whether it was inserted. */
+    std::pair<ssize_t, bool>
+    find_or_insert(const Slot & toInsert)
+    {
+        ssize_t index = find_full_bucket(KeyOf::get(toInsert));
+        if (index != NO_BUCKET)
+            return std::make_pair(index, false);
+        return std::make_pair(insertUnique(toInsert), true);
+    }
+
+    void eraseAt(ssize_t index)
+    {
+        ExcAssertGreaterEqual(ctrl_[index], 0);
+        slots_[index].~Slot();
+        --size_;
+
+        size_t group = index / SwissGroup::WIDTH;
+        SwissGroup g(ctrl_ + group * SwissGroup::WIDTH);
+        if (g.matchEmpty()) {
+            ctrl_[index] = SwissGroup::EMPTY;
+            ++growthLeft_;
+        }
+        else ctrl_[index] = SwissGroup::DELETED;
+    }
+
+    /** First full slot at or after index, or the capacity if none. */
+    ssize_t advance_to_valid(ssize_t index) const
+    {
+        if (index >= capacity_)
+            return capacity_;
+
+        // Finish the group we're in, then go a group at a time
+        size_t group = index / SwissGroup::WIDTH;
+        uint32_t m = SwissGroup(ctrl_ + group * SwissGroup::WIDTH).matchFull();
+        m &= ~0U << (index % SwissGroup::WIDTH);
+        while (!m) {
+            if (++group == numGroups())
+                return capacity_;
+            m = SwissGroup(ctrl_ + group * SwissGroup::WIDTH).matchFull();
+        }
+        return group * SwissGroup::WIDTH + __builtin_ctz(m);
+    }
+
+    /** Last full slot at or before index. */
+    ssize_t backup_to_valid(ssize_t index) const
+    {
+        while (index >= 0 && ctrl_[index] < 0)
+            --index;
+        if (index < 0)
+            throw Exception("decrement past the start");
+        return index;
+    }
+};
+
+
+/*****************************************************************************/
+/* SWISS HASH MAP                                                            */
+/*****************************************************************************/
+
+/** Extracts the key from a bucket.  Small keys are returned by value,
+    which also allows them to live in packed buckets.
+*/
+template<typename Key, typename Bucket>
+struct SwissPairKeyOf {
+    typedef typename std::conditional<std::is_trivially_copyable<Key>::value
+                                      && sizeof(Key) <= 16,
+                                      Key, const Key &>::type Result;
+
+    static Result get(const Bucket & bucket)
+    {
+        return bucket.first;
+    }
+};
+
+/** Hash map with the interface of LightweightHash.  Bucket is the type
+    stored, which needs first and second members; iterators present it as
+    a ConstKeyBucket.  Unlike LightweightHash, any key (including zero) may
+    be stored.
+*/
+
+template<typename Key,
+         typename Value,
+         class Bucket = std::pair<Key, Value>,
+         class ConstKeyBucket = std::pair<const Key, Value>,
+         class Hash = SwissHashFn<Key> >
+struct SwissHash
+    : public SwissHashBase<Key, Bucket, SwissPairKeyOf<Key, Bucket>, Hash> {
+
+    typedef SwissHashBase<Key, Bucket, SwissPairKeyOf<Key, Bucket>, Hash> Base;
+
+    typedef SwissHashIterator<const SwissHash, const Bucket> const_iterator;
+    typedef SwissHashIterator<SwissHash, ConstKeyBucket> iterator;
+
+    SwissHash()
+    {
+    }
+
+    template<class Iterator>
+    SwissHash(Iterator first, Iterator last, size_t capacity = 0)
+    {
+        this->reserve(capacity ? capacity : std::distance(first, last));
+        for (;  first != last;  ++first)
+            insert(*first);
+    }
+
+    SwissHash(const SwissHash & other) = default;
+    SwissHash(SwissHash && other) = default;
+    SwissHash & operator = (const SwissHash & other) = default;
+    SwissHash & operator = (SwissHash && other) = default;
+
+    void swap(SwissHash & other)
+    {
+        Base::swap(other);
+    }
+
+    using Base::size;
+    using Base::empty;
+    using Base::capacity;
+    using Base::clear;
+    using Base::reserve;
+    using Base::count;
+    using Base::erase;
+    using Base::NO_BUCKET;
+
+    iterator begin()
+    {
+        return iterator(this, 0);
+    }
+
+    iterator end()
+    {
+        return iterator(this, this->capacity());
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, this->capacity());
+    }
+
+    iterator find(const Key & key)
+    {
+        ssize_t bucket = this->find_full_bucket(key);
+        if (bucket == NO_BUCKET) return end();
+        return iterator(this, bucket);
+    }
+
+    const_iterator find(const Key & key) const
+    {
+        ssize_t bucket = this->find_full_bucket(key);
+        if (bucket == NO_BUCKET) return end();
+        return const_iterator(this, bucket);
+    }
+
+    Value & operator [] (const Key & key)
+    {
+        ssize_t bucket = this->find_or_insert(Bucket(key, Value())).first;
+        return this->slots_[bucket].second;
+    }
+
+    std::pair<iterator, bool>
+    insert(const Bucket & val)
+    {
+        std::pair<ssize_t, bool> r = this->find_or_insert(val);
+        return std::make_pair(iterator(this, r.first), r.second);
+    }
+
+    /** Erase the entry the iterator points to, returning an iterator to the
+        next one.
+    */
+    iterator erase(iterator it)
+    {
+        this->eraseAt(it.index);
+        return iterator(this, it.index + 1);
+    }
+
+private:
+    template<class T, class V>
+    friend class SwissHashIterator;
+
+    const Bucket & dereference(ssize_t bucket) const
+    {
+        if (bucket < 0 || bucket >= this->capacity() || this->ctrl_[bucket] < 0)
+            throw Exception("dereferencing invalid iterator");
+        return this->slots_[bucket];
+    }
+
+    ConstKeyBucket & dereference(ssize_t bucket)
+    {
+        const Bucket & result = static_cast<const SwissHash *>(this)
+            ->dereference(bucket);
+        return reinterpret_cast<ConstKeyBucket &>
+            (const_cast<Bucket &>(result));
+    }
+};
+
+
+/*****************************************************************************/
+/* SWISS HASH SET                                                            */
+/*****************************************************************************/
+
+template<typename Key>
+struct SwissScalarKeyOf {
+    static const Key & get(const Key & key)
+    {
+        return key;
+    }
+};
+
+/** Hash set with the interface of LightweightHash_Set. */
+
+template<typename Key, class Hash = SwissHashFn<Key> >
+struct SwissHash_Set
+    : public SwissHashBase<Key, Key, SwissScalarKeyOf<Key>, Hash> {
+
+    typedef SwissHashBase<Key, Key, SwissScalarKeyOf<Key>, Hash> Base;
+
+    typedef SwissHashIterator<const SwissHash_Set, const Key> const_iterator;
+    typedef const_iterator iterator;
+
+    SwissHash_Set()
+    {
+    }
+
+    SwissHash_Set(const std::initializer_list<Key> & init)
+        : SwissHash_Set(init.begin(), init.end())
+    {
+    }
+
+    template<class Iterator>
+    SwissHash_Set(Iterator first, Iterator last, size_t capacity = 0)
+    {
+        this->reserve(capacity ? capacity : std::distance(first, last));
+        insert(first, last);
+    }
+
+    SwissHash_Set(const SwissHash_Set & other) = default;
+    SwissHash_Set(SwissHash_Set && other) = default;
+    SwissHash_Set & operator = (const SwissHash_Set & other) = default;
+    SwissHash_Set & operator = (SwissHash_Set && other) = default;
+
+    void swap(SwissHash_Set & other)
+    {
+        Base::swap(other);
+    }
+
+    using Base::size;
+    using Base::empty;
+    using Base::capacity;
+    using Base::clear;
+    using Base::reserve;
+    using Base::count;
+    using Base::erase;
+    using Base::NO_BUCKET;
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, this->capacity());
+    }
+
+    const_iterator find(const Key & key) const
+    {
+        ssize_t bucket = this->find_full_bucket(key);
+        if (bucket == NO_BUCKET) return end();
+        return const_iterator(this, bucket);
+    }
+
+    std::pair<const_iterator, bool>
+    insert(const Key & val)
+    {
+        std::pair<ssize_t, bool> r = this->find_or_insert(val);
+        return std::make_pair(const_iterator(this, r.first), r.second);
+    }
+
+    template<typename Iterator>
+    size_t insert(Iterator first, Iterator last)
+    {
+        size_t result = 0;
+        for (; first != last;  ++first)
+            result += insert(*first).second;
+        return result;
+    }
+
+private:
+    template<class T, class V>
+    friend class SwissHashIterator;
+
+    const Key & dereference(ssize_t bucket) const
+    {
+        if (bucket < 0 || bucket >= this->capacity() || this->ctrl_[bucket] < 0)
+            throw Exception("dereferencing invalid iterator");
+        return this->slots_[bucket];
+    }
+};
+
+} // namespace MLDB
@@ -0,0 +1,143 @@
+/* hnsw_index_benchmark.cc                                         -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Benchmark of the recall and query latency of the HNSW index against the
+   vantage point tree, on synthetic clustered 64 dimensional data.  The
+   number of points defaults to 100k and can be overridden with the
+   HNSW_BENCHMARK_SIZE environment variable.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/hnsw_index.h"
+#include "mldb/utils/vantage_point_tree.h"
+#include "mldb/arch/timers.h"
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+using namespace MLDB;
+using namespace std;
+
+
+namespace {
+
+int nd = 64;
+
+/** Points in 100 gaussian clusters, as in a typical embedding. */
+std::vector<distribution<float> > makePoints(int n, int seed)
+{
+    int numClusters = 100;
+    mt19937 rng(1);
+    normal_distribution<float> normal;
+
+    std::vector<distribution<float> > centres(numClusters,
+                                              distribution<float>(nd));
+    for (auto & c: centres)
+        for (auto & x: c)
+            x = normal(rng);
+
+    rng.seed(seed);
+    std::vector<distribution<float> > result(n, distribution<float>(nd));
+    for (int i = 0;  i < n;  ++i) {
+        const auto & centre = centres[rng() % numClusters];
+        for (int j = 0;  j < nd;  ++j)
+            result[i][j] = centre[j] + 0.3 * normal(rng);
+    }
+    return result;
+}
+
+float dist(const distribution<float> & p1, const distribution<float> & p2)
+{
+    return (p1 - p2).two_norm();
+}
+
+struct LatencyStats {
+    std::vector<double> latencies;
+    size_t found = 0;
+    size_t expected = 0;
+
+    void print(const std::string & name)
+    {
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&] (double p)
+            {
+                return 1000.0 * latencies[p * (latencies.size() - 1)];
+            };
+        cerr << name << ": recall " << 1.0 * found / expected
+             << " p50 " << percentile(0.5) << "ms p99 " << percentile(0.99)
+             << "ms" << endl;
+    }
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( benchmark_hnsw_versus_vantage_point_tree )
+{
+    const char * env = getenv("HNSW_BENCHMARK_SIZE");
+    int n = env ? stoi(env) : 100000;
+    int numQueries = 1000;
+    int k = 10;
+
+    auto points = makePoints(n, 2);
+    auto queries = makePoints(numQueries, 3);
+    auto pointDist = [&] (int i1, int i2) { return dist(points[i1], points[i2]); };
+
+    std::vector<std::vector<int> > exact(numQueries);
+    for (int q = 0;  q < numQueries;  ++q) {
+        std::vector<std::pair<float, int> > all;
+        for (int i = 0;  i < n;  ++i)
+            all.emplace_back(dist(queries[q], points[i]), i);
+        std::partial_sort(all.begin(), all.begin() + k, all.end());
+        for (int i = 0;  i < k;  ++i)
+            exact[q].push_back(all[i].second);
+    }
+
+    auto run = [&] (const std::string & name,
+                    const std::function<std::vector<std::pair<float, int> >
+                                        (const HnswIndex::Distance &)> & search)
+        {
+            LatencyStats stats;
+            for (int q = 0;  q < numQueries;  ++q) {
+                Timer timer;
+                auto found = search([&] (int i) { return dist(queries[q], points[i]); });
+                stats.latencies.push_back(timer.elapsed_wall());
+                for (auto & f: found) {
+                    stats.found += std::count(exact[q].begin(), exact[q].end(),
+                                              f.second);
+                }
+                stats.expected += k;
+            }
+            stats.print(name);
+        };
+
+    std::vector<int> items;
+    for (int i = 0;  i < n;  ++i)
+        items.push_back(i);
+
+    Timer timer;
+    std::unique_ptr<VantagePointTree> vpTree
+        (VantagePointTree::create(items, pointDist));
+    cerr << n << " points: vantage point tree built in "
+         << timer.elapsed_wall() << "s" << endl;
+
+    run("vpTree", [&] (const HnswIndex::Distance & d)
+        {
+            return vpTree->search(d, k, INFINITY);
+        });
+
+    timer.restart();
+    HnswIndex hnsw(16, 200);
+    for (int i = 0;  i < n;  ++i)
+        hnsw.insert(i, pointDist);
+    cerr << n << " points: hnsw index built in "
+         << timer.elapsed_wall() << "s" << endl;
+
+    for (int efSearch: { 16, 32, 64, 128, 256 }) {
+        run("hnsw efSearch " + to_string(efSearch),
+            [&] (const HnswIndex::Distance & d)
+            {
+                return hnsw.search(d, k, INFINITY, efSearch);
+            });
+    }
+}
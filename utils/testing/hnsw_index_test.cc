@@ -0,0 +1,188 @@
+/* hnsw_index_test.cc                                              -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of the HNSW approximate nearest neighbour index.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/hnsw_index.h"
+#include "mldb/types/db/persistent.h"
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <sstream>
+
+using namespace MLDB;
+using namespace std;
+
+
+namespace {
+
+struct Points {
+    Points(int n, int nd, int seed = 1)
+        : nd(nd), coords(n * nd)
+    {
+        mt19937 rng(seed);
+        normal_distribution<float> normal;
+        for (auto & c: coords)
+            c = normal(rng);
+    }
+
+    int size() const
+    {
+        return coords.size() / nd;
+    }
+
+    float dist(const float * p1, const float * p2) const
+    {
+        float result = 0;
+        for (int i = 0;  i < nd;  ++i)
+            result += (p1[i] - p2[i]) * (p1[i] - p2[i]);
+        return sqrt(result);
+    }
+
+    float dist(int i1, int i2) const
+    {
+        return dist(&coords[i1 * nd], &coords[i2 * nd]);
+    }
+
+    std::vector<std::pair<float, int> >
+    exact(const float * query, int n) const
+    {
+        std::vector<std::pair<float, int> > result;
+        for (int i = 0;  i < size();  ++i)
+            result.emplace_back(dist(query, &coords[i * nd]), i);
+        std::sort(result.begin(), result.end());
+        result.resize(std::min<size_t>(n, result.size()));
+        return result;
+    }
+
+    int nd;
+    std::vector<float> coords;
+};
+
+HnswIndex build(const Points & points, int M = 16, int efConstruction = 100,
+                int numPoints = -1)
+{
+    if (numPoints == -1)
+        numPoints = points.size();
+    HnswIndex result(M, efConstruction);
+    for (int i = 0;  i < numPoints;  ++i) {
+        result.insert(i, [&] (int i1, int i2) { return points.dist(i1, i2); });
+    }
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_hnsw_recall )
+{
+    Points points(5000, 16);
+    HnswIndex index = build(points);
+    BOOST_CHECK_EQUAL(index.size(), 5000);
+
+    Points queries(200, 16, 2);
+    int k = 10;
+    size_t found = 0;
+
+    for (int q = 0;  q < queries.size();  ++q) {
+        const float * query = &queries.coords[q * queries.nd];
+        auto exact = points.exact(query, k);
+        auto approx = index.search([&] (int i) { return points.dist(query, &points.coords[i * points.nd]); },
+                                   k, INFINITY, 64);
+        BOOST_REQUIRE_EQUAL(approx.size(), k);
+        BOOST_CHECK(std::is_sorted(approx.begin(), approx.end()));
+
+        for (auto & e: exact) {
+            for (auto & a: approx) {
+                if (a.second == e.second) {
+                    ++found;
+                    break;
+                }
+            }
+        }
+    }
+
+    double recall = 1.0 * found / (k * queries.size());
+    cerr << "recall@" << k << " = " << recall << endl;
+    BOOST_CHECK_GE(recall, 0.95);
+}
+
+BOOST_AUTO_TEST_CASE( test_hnsw_small_and_max_distance )
+{
+    HnswIndex empty;
+    BOOST_CHECK(empty.search([] (int) { return 0.0f; }, 10, INFINITY, 10).empty());
+
+    // Points on a line, so that the answers are known exactly
+    std::vector<float> line;
+    HnswIndex index(4, 20);
+    for (int i = 0;  i < 100;  ++i) {
+        line.push_back(i);
+        index.insert(i, [&] (int i1, int i2) { return fabs(line[i1] - line[i2]); });
+    }
+
+    auto result = index.search([&] (int i) { return fabs(line[i] - 50.2f); },
+                               10, 2.5, 50);
+    std::vector<int> items;
+    for (auto & r: result)
+        items.push_back(r.second);
+    std::vector<int> expected = { 50, 51, 49, 52, 48 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(items.begin(), items.end(),
+                                  expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE( test_hnsw_insert_exception_safe )
+{
+    Points points(200, 4);
+    HnswIndex index = build(points, 8, 50);
+
+    auto query = [&] (int i) { return points.dist(0, i); };
+    auto before = index.search(query, 10, INFINITY, 50);
+
+    BOOST_CHECK_THROW(index.insert(200, [] (int, int) -> float
+                                   { throw std::runtime_error("bad distance"); }),
+                      std::runtime_error);
+    BOOST_CHECK_EQUAL(index.size(), 200);
+
+    auto after = index.search(query, 10, INFINITY, 50);
+    BOOST_CHECK(before == after);
+}
+
+BOOST_AUTO_TEST_CASE( test_hnsw_serialize_reconstitute )
+{
+    Points points(1100, 8);
+    HnswIndex index = build(points, 16, 100, 1000);
+
+    ostringstream stream_out;
+    {
+        DB::Store_Writer store(stream_out);
+        index.serialize(store);
+    }
+
+    istringstream stream_in(stream_out.str());
+    DB::Store_Reader store(stream_in);
+    HnswIndex index2;
+    index2.reconstitute(store);
+
+    BOOST_CHECK_EQUAL(index2.size(), index.size());
+
+    for (int q = 0;  q < 50;  ++q) {
+        auto query = [&] (int i) { return points.dist(q, i); };
+        auto r1 = index.search(query, 10, INFINITY, 32);
+        auto r2 = index2.search(query, 10, INFINITY, 32);
+        BOOST_CHECK(r1 == r2);
+    }
+
+    // Inserting into both gives the same graph, as levels are deterministic
+    auto dist = [&] (int i1, int i2) { return points.dist(i1, i2); };
+    for (int i = 1000;  i < 1100;  ++i) {
+        index.insert(i, dist);
+        index2.insert(i, dist);
+    }
+    for (int q = 1000;  q < 1050;  ++q) {
+        auto query = [&] (int i) { return points.dist(q, i); };
+        BOOST_CHECK(index.search(query, 10, INFINITY, 32)
+                    == index2.search(query, 10, INFINITY, 32));
+    }
+}
@@ -0,0 +1,167 @@
+/* lru_cache_test.cc                                               -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of the least recently used cache.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/lru_cache.h"
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+#include <string>
+
+using namespace MLDB;
+using namespace std;
+
+
+BOOST_AUTO_TEST_CASE( test_lru_eviction_order )
+{
+    LruCache<int, string> cache(2);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+
+    // Touch 1 so that 2 is the least recently used
+    string val;
+    BOOST_CHECK(cache.get(1, val));
+    BOOST_CHECK_EQUAL(val, "one");
+
+    cache.put(3, "three");
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+    BOOST_CHECK(!cache.get(2, val));
+    BOOST_CHECK(cache.get(1, val));
+    BOOST_CHECK(cache.get(3, val));
+    BOOST_CHECK_EQUAL(val, "three");
+
+    // Replacing doesn't evict
+    cache.put(3, "THREE");
+    BOOST_CHECK(cache.get(3, val));
+    BOOST_CHECK_EQUAL(val, "THREE");
+
+    auto stats = cache.stats();
+    BOOST_CHECK_EQUAL(stats.size, 2);
+    BOOST_CHECK_EQUAL(stats.capacity, 2);
+    BOOST_CHECK_EQUAL(stats.hits, 4);
+    BOOST_CHECK_EQUAL(stats.misses, 1);
+    BOOST_CHECK_EQUAL(stats.evictions, 1);
+
+    cache.setCapacity(1);
+    BOOST_CHECK_EQUAL(cache.size(), 1);
+    BOOST_CHECK(cache.get(3, val));
+    BOOST_CHECK(!cache.get(1, val));
+
+    BOOST_CHECK(cache.erase(3));
+    BOOST_CHECK(!cache.erase(3));
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_lru_disabled )
+{
+    LruCache<int, int> cache(0);
+    cache.put(1, 1);
+    int val;
+    BOOST_CHECK(!cache.get(1, val));
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+
+    int created = 0;
+    BOOST_CHECK_EQUAL(cache.getOrCreate(1, [&] () { return ++created; }), 1);
+    BOOST_CHECK_EQUAL(cache.getOrCreate(1, [&] () { return ++created; }), 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_lru_get_or_create )
+{
+    LruCache<string, int> cache(10);
+    int created = 0;
+    auto create = [&] () { return ++created; };
+
+    BOOST_CHECK_EQUAL(cache.getOrCreate("a", create), 1);
+    BOOST_CHECK_EQUAL(cache.getOrCreate("a", create), 1);
+    BOOST_CHECK_EQUAL(cache.getOrCreate("b", create), 2);
+    BOOST_CHECK_EQUAL(created, 2);
+
+    cache.clear();
+    BOOST_CHECK_EQUAL(cache.getOrCreate("a", create), 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_lru_multithreaded )
+{
+    LruCache<int, int> cache(50);
+
+    std::vector<std::thread> threads;
+    for (int t = 0;  t < 8;  ++t) {
+        threads.emplace_back([&cache, t] ()
+            {
+                for (int i = 0;  i < 10000;  ++i) {
+                    int key = (i * 7 + t) % 100;
+                    int val = cache.getOrCreate(key, [&] () { return key * 2; });
+                    BOOST_REQUIRE_EQUAL(val, key * 2);
+                }
+            });
+    }
+
+    for (auto & t: threads)
+        t.join();
+
+    auto stats = cache.stats();
+    BOOST_CHECK_LE(stats.size, 50);
+    BOOST_CHECK_EQUAL(stats.hits + stats.misses, 80000);
+}
+
+BOOST_AUTO_TEST_CASE( test_sharded_lru )
+{
+    ShardedLruCache<int, int> cache(64, 4);
+    BOOST_CHECK_EQUAL(cache.capacity(), 64);
+
+    for (int i = 0;  i < 1000;  ++i)
+        cache.put(i, i * 2);
+
+    // Each shard is full, and holds at most its part of the capacity
+    BOOST_CHECK_LE(cache.size(), 64);
+    BOOST_CHECK_GT(cache.size(), 0);
+
+    int val;
+    BOOST_CHECK(cache.get(999, val));
+    BOOST_CHECK_EQUAL(val, 1998);
+    BOOST_CHECK(!cache.get(0, val));
+
+    auto stats = cache.stats();
+    BOOST_CHECK_EQUAL(stats.hits, 1);
+    BOOST_CHECK_EQUAL(stats.misses, 1);
+    BOOST_CHECK_EQUAL(stats.evictions, 1000 - stats.size);
+    BOOST_CHECK_EQUAL(stats.capacity, 64);
+
+    cache.clear();
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+
+    ShardedLruCache<int, int> disabled(0);
+    disabled.put(1, 1);
+    BOOST_CHECK(!disabled.get(1, val));
+}
+
+BOOST_AUTO_TEST_CASE( test_sharded_lru_multithreaded )
+{
+    ShardedLruCache<int, int> cache(1000);
+
+    std::vector<std::thread> threads;
+    for (int t = 0;  t < 8;  ++t) {
+        threads.emplace_back([&cache, t] ()
+            {
+                for (int i = 0;  i < 10000;  ++i) {
+                    int key = (i * 7 + t) % 100;
+                    int val = cache.getOrCreate(key, [&] () { return key * 2; });
+                    BOOST_REQUIRE_EQUAL(val, key * 2);
+                }
+            });
+    }
+
+    for (auto & t: threads)
+        t.join();
+
+    auto stats = cache.stats();
+    BOOST_CHECK_EQUAL(stats.size, 100);
+    BOOST_CHECK_EQUAL(stats.hits + stats.misses, 80000);
+    BOOST_CHECK_GE(stats.misses, 100);
+}
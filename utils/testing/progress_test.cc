@@ -0,0 +1,92 @@
+/* progress_test.cc                                                -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of the concurrent progress counter and reporter.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/progress.h"
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+#include <chrono>
+
+using namespace MLDB;
+using namespace std;
+
+
+BOOST_AUTO_TEST_CASE( test_progress_counter_many_threads )
+{
+    ProgressCounter counter;
+
+    vector<std::thread> threads;
+    for (unsigned t = 0;  t < 100;  ++t) {
+        threads.emplace_back([&] ()
+            {
+                for (unsigned i = 0;  i < 10000;  ++i)
+                    counter.add();
+            });
+    }
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(counter.total(), 100 * 10000);
+}
+
+BOOST_AUTO_TEST_CASE( test_progress_reporter )
+{
+    ProgressCounter counter;
+    std::atomic<int> numReports(0);
+    uint64_t lastReported = 0;
+    bool monotonic = true;
+
+    ProgressReporter reporter
+        ([&] () { return counter.total(); },
+         [&] (uint64_t value)
+         {
+             // Only ever called from one thread at a time
+             monotonic = monotonic && value > lastReported;
+             lastReported = value;
+             ++numReports;
+             return true;
+         },
+         0.01 /* seconds */);
+
+    vector<std::thread> threads;
+    for (unsigned t = 0;  t < 4;  ++t) {
+        threads.emplace_back([&] ()
+            {
+                for (unsigned i = 0;  i < 20;  ++i) {
+                    counter.add(10);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+            });
+    }
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK(reporter.finish());
+    BOOST_CHECK(monotonic);
+    BOOST_CHECK_GT(numReports, 1);
+
+    // The final value is always reported
+    BOOST_CHECK_EQUAL(lastReported, 4 * 20 * 10);
+}
+
+BOOST_AUTO_TEST_CASE( test_progress_reporter_cancel )
+{
+    ProgressCounter counter;
+
+    ProgressReporter reporter
+        ([&] () { return counter.total(); },
+         [&] (uint64_t value) { return false; },
+         0.001 /* seconds */);
+
+    counter.add();
+    while (!reporter.cancelled())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    BOOST_CHECK(!reporter.finish());
+}
@@ -0,0 +1,243 @@
+/* sketches_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Tests for the mergeable sketches.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/utils/sketches.h"
+#include "mldb/arch/exception_handler.h"
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+using namespace MLDB;
+
+// Well mixed 64 bit hash of an integer (splitmix64)
+static uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+BOOST_AUTO_TEST_CASE( test_hll_accuracy )
+{
+    for (uint64_t n: { 0, 1, 10, 1000, 10000, 100000, 1000000 }) {
+        HyperLogLog hll;
+        for (uint64_t i = 0;  i < n;  ++i) {
+            hll.insertHash(mix(i));
+            hll.insertHash(mix(i));  // duplicates don't count
+        }
+        double est = hll.estimate();
+        BOOST_CHECK_LE(fabs(est - n), 0.03 * n + 0.5);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_hll_sparse_to_dense )
+{
+    HyperLogLog hll(12);
+    for (uint64_t i = 0;  i < 100;  ++i)
+        hll.insertHash(mix(i));
+    BOOST_CHECK(hll.isSparse());
+    for (uint64_t i = 100;  i < 100000;  ++i)
+        hll.insertHash(mix(i));
+    BOOST_CHECK(!hll.isSparse());
+}
+
+BOOST_AUTO_TEST_CASE( test_hll_merge_and_serialize )
+{
+    HyperLogLog all, part1, part2, small;
+    for (uint64_t i = 0;  i < 50000;  ++i) {
+        all.insertHash(mix(i));
+        (i % 2 ? part1 : part2).insertHash(mix(i));
+    }
+    for (uint64_t i = 0;  i < 10;  ++i)
+        small.insertHash(mix(i + 1000000));
+
+    // Round trip through the serialized form, both dense and sparse
+    std::string s1 = part1.serialize(), s2 = small.serialize();
+    BOOST_CHECK(HyperLogLog::isSerialized(s1.data(), s1.size()));
+    HyperLogLog merged = HyperLogLog::reconstitute(s1.data(), s1.size());
+    merged.merge(part2);
+    BOOST_CHECK_EQUAL(merged.estimate(), all.estimate());
+
+    merged.merge(HyperLogLog::reconstitute(s2.data(), s2.size()));
+    all.merge(small);
+    BOOST_CHECK_EQUAL(merged.estimate(), all.estimate());
+
+    MLDB_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(HyperLogLog::reconstitute(s1.data(), s1.size() - 1),
+                      std::exception);
+    BOOST_CHECK_THROW(merged.merge(HyperLogLog(10)), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_tdigest_exact_small )
+{
+    TDigest digest;
+    BOOST_CHECK(std::isnan(digest.quantile(0.5)));
+
+    for (double x: { 3, 1, 4, 2, 5 })
+        digest.insert(x);
+
+    BOOST_CHECK_EQUAL(digest.quantile(0.5), 3);
+    BOOST_CHECK_EQUAL(digest.quantile(0), 1);
+    BOOST_CHECK_EQUAL(digest.quantile(1), 5);
+    BOOST_CHECK_EQUAL(digest.weight(), 5);
+}
+
+BOOST_AUTO_TEST_CASE( test_tdigest_accuracy )
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<double> dist;
+
+    std::vector<double> values;
+    TDigest digest, part1, part2;
+    for (int i = 0;  i < 100000;  ++i) {
+        double x = dist(rng);
+        values.push_back(x);
+        digest.insert(x);
+        (i % 3 ? part1 : part2).insert(x);
+    }
+    std::sort(values.begin(), values.end());
+
+    std::string s = part2.serialize();
+    TDigest merged = TDigest::reconstitute(s.data(), s.size());
+    merged.merge(part1);
+
+    BOOST_CHECK_LE(digest.numCentroids(), 2 * digest.compression());
+
+    for (double q: { 0.001, 0.01, 0.1, 0.5, 0.9, 0.99, 0.999 }) {
+        double exact = values[q * values.size()];
+        // Errors are in the rank, and are smaller near the tails
+        double tolerance = 0.01 * std::max(q * (1 - q) * 4, 0.05);
+        for (const TDigest * d: { &digest, &merged }) {
+            double est = d->quantile(q);
+            size_t rank = std::lower_bound(values.begin(), values.end(), est)
+                - values.begin();
+            BOOST_CHECK_LE(fabs((double)rank / values.size() - q), tolerance);
+            BOOST_CHECK_LE(fabs(est - exact), 0.1);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_kll_exact_small )
+{
+    KllSketch sketch;
+    BOOST_CHECK(std::isnan(sketch.quantile(0.5)));
+
+    for (double x: { 3, 1, 4, 1, 5 })
+        sketch.insert(x);
+
+    BOOST_CHECK(sketch.isExact());
+    BOOST_CHECK_EQUAL(sketch.quantile(0.5), 3);
+    BOOST_CHECK_EQUAL(sketch.quantile(0), 1);
+    BOOST_CHECK_EQUAL(sketch.quantile(1), 5);
+
+    auto values = sketch.getWeightedValues();
+    BOOST_REQUIRE_EQUAL(values.size(), 4);
+    BOOST_CHECK_EQUAL(values[0].first, 1);
+    BOOST_CHECK_EQUAL(values[0].second, 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_kll_accuracy )
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<double> dist;
+
+    std::vector<double> values;
+    KllSketch sketch, part1, part2;
+    for (int i = 0;  i < 100000;  ++i) {
+        double x = dist(rng);
+        values.push_back(x);
+        sketch.insert(x);
+        (i % 3 ? part1 : part2).insert(x);
+    }
+    std::sort(values.begin(), values.end());
+
+    std::string s = part2.serialize();
+    KllSketch merged = KllSketch::reconstitute(s.data(), s.size());
+    merged.merge(part1);
+
+    BOOST_CHECK_EQUAL(merged.count(), values.size());
+    BOOST_CHECK(!sketch.isExact());
+    BOOST_CHECK_LE(sketch.numRetained(), 4 * sketch.k());
+
+    uint64_t total = 0;
+    for (auto & v: merged.getWeightedValues())
+        total += v.second;
+    BOOST_CHECK_EQUAL(total, values.size());
+
+    for (double q: { 0.01, 0.1, 0.5, 0.9, 0.99 }) {
+        for (const KllSketch * k: { &sketch, &merged }) {
+            double est = k->quantile(q);
+            size_t rank = std::lower_bound(values.begin(), values.end(), est)
+                - values.begin();
+            BOOST_CHECK_LE(fabs((double)rank / values.size() - q), 0.02);
+        }
+    }
+
+    MLDB_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(KllSketch::reconstitute(s.data(), s.size() - 1),
+                      std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_count_min )
+{
+    CountMinSketch cms(1000, 5);
+    for (uint64_t i = 0;  i < 100;  ++i)
+        cms.insertHash(mix(i), i);
+
+    for (uint64_t i = 0;  i < 100;  ++i) {
+        BOOST_CHECK_GE(cms.estimateHash(mix(i)), i);
+        BOOST_CHECK_LE(cms.estimateHash(mix(i)), i + cms.total() / 100);
+    }
+
+    std::string s = cms.serialize();
+    CountMinSketch cms2 = CountMinSketch::reconstitute(s.data(), s.size());
+    cms2.merge(cms);
+    BOOST_CHECK_EQUAL(cms2.estimateHash(mix(50)), 2 * cms.estimateHash(mix(50)));
+
+    MLDB_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(cms2.merge(CountMinSketch(100, 5)), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_heavy_hitters )
+{
+    // Zipf-like: value i occurs about 10000 / (i + 1) times
+    HeavyHitters all(5), part1(5), part2(5);
+    for (int i = 0;  i < 1000;  ++i) {
+        int count = 10000 / (i + 1);
+        for (int j = 0;  j < count;  ++j) {
+            std::string value = "v" + std::to_string(i);
+            all.insert(value, mix(i));
+            (j % 2 ? part1 : part2).insert(value, mix(i));
+        }
+    }
+
+    auto check = [] (const HeavyHitters & hh)
+        {
+            auto top = hh.top();
+            BOOST_REQUIRE_EQUAL(top.size(), 5);
+            for (int i = 0;  i < 5;  ++i) {
+                BOOST_CHECK_EQUAL(top[i].value, "v" + std::to_string(i));
+                BOOST_CHECK_GE(top[i].count, 10000 / (i + 1));
+            }
+        };
+
+    check(all);
+
+    std::string s = part1.serialize();
+    BOOST_CHECK(HeavyHitters::isSerialized(s.data(), s.size()));
+    HeavyHitters merged = HeavyHitters::reconstitute(s.data(), s.size());
+    merged.merge(part2);
+    check(merged);
+    BOOST_CHECK_EQUAL(merged.total(), all.total());
+}
@@ -0,0 +1,150 @@
+/* string_counts_table_test.cc                                     -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of the compact string to counts table.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/string_counts_table.h"
+#include "mldb/types/db/persistent.h"
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+
+using namespace MLDB;
+using namespace std;
+
+namespace {
+
+void increment(StringCountsTable & table, const string & key, int64_t n)
+{
+    int64_t * c = table.insert(key.data(), key.size(),
+                               StringCountsTable::hashKey(key.data(),
+                                                          key.size()));
+    c[0] += 1;
+    c[1] += n;
+}
+
+void checkEqual(const StringCountsTable & table,
+                const map<string, pair<int64_t, int64_t> > & expected)
+{
+    BOOST_CHECK_EQUAL(table.size(), expected.size());
+    for (size_t i = 0;  i < table.size();  ++i) {
+        string key(table.keyData(i), table.keyLength(i));
+        auto it = expected.find(key);
+        BOOST_REQUIRE(it != expected.end());
+        BOOST_CHECK_EQUAL(table.counts(i)[0], it->second.first);
+        BOOST_CHECK_EQUAL(table.counts(i)[1], it->second.second);
+    }
+    for (auto & e: expected) {
+        const int64_t * c = table.get(e.first.data(), e.first.size());
+        BOOST_CHECK_EQUAL(c[0], e.second.first);
+        BOOST_CHECK_EQUAL(c[1], e.second.second);
+    }
+    BOOST_CHECK_EQUAL(table.get("not there", 9)[0], 0);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_insert_and_get )
+{
+    StringCountsTable table(2);
+    map<string, pair<int64_t, int64_t> > expected;
+
+    for (int i = 0;  i < 10000;  ++i) {
+        string key = "key" + to_string(i % 777);
+        increment(table, key, i);
+        expected[key].first += 1;
+        expected[key].second += i;
+    }
+
+    // The empty key is a key like any other
+    increment(table, "", 3);
+    expected[""] = { 1, 3 };
+
+    checkEqual(table, expected);
+    BOOST_CHECK(!table.isMapped());
+}
+
+BOOST_AUTO_TEST_CASE( test_merge )
+{
+    vector<StringCountsTable> shards(5, StringCountsTable(2));
+    map<string, pair<int64_t, int64_t> > expected;
+
+    for (int i = 0;  i < 50000;  ++i) {
+        string key = "w" + to_string((i * 7919) % 4001);
+        increment(shards[i % shards.size()], key, 1);
+        expected[key].first += 1;
+        expected[key].second += 1;
+    }
+
+    vector<const StringCountsTable *> tables;
+    for (auto & s: shards)
+        tables.push_back(&s);
+
+    checkEqual(StringCountsTable::merge(tables, 2), expected);
+
+    // Merging a single table gives a copy of it
+    map<string, pair<int64_t, int64_t> > first;
+    for (size_t i = 0;  i < shards[0].size();  ++i) {
+        first[string(shards[0].keyData(i), shards[0].keyLength(i))]
+            = { shards[0].counts(i)[0], shards[0].counts(i)[1] };
+    }
+    checkEqual(StringCountsTable::merge({ tables[0] }, 2), first);
+}
+
+BOOST_AUTO_TEST_CASE( test_serialize_reconstitute )
+{
+    StringCountsTable table(2);
+    map<string, pair<int64_t, int64_t> > expected;
+    for (int i = 0;  i < 1000;  ++i) {
+        string key = "k" + to_string(i);
+        increment(table, key, i);
+        expected[key] = { 1, i };
+    }
+
+    ostringstream stream_out;
+    {
+        DB::Store_Writer store(stream_out);
+        store << string("header");
+        table.serialize(store);
+    }
+    string serialized = stream_out.str();
+
+    // Copied out of the stream
+    {
+        istringstream stream_in(serialized);
+        DB::Store_Reader store(stream_in);
+        string header;
+        store >> header;
+        StringCountsTable loaded;
+        loaded.reconstitute(store);
+        BOOST_CHECK(!loaded.isMapped());
+        checkEqual(loaded, expected);
+
+        // A copied table can still be added to
+        increment(loaded, "new", 1);
+        BOOST_CHECK_EQUAL(loaded.size(), expected.size() + 1);
+    }
+
+    // Used in place, as when the file is memory mapped.  The buffer
+    // needs to be aligned like a mapped file would be.
+    {
+        auto buffer = std::make_shared<vector<uint64_t> >
+            ((serialized.size() + 7) / 8);
+        memcpy(buffer->data(), serialized.data(), serialized.size());
+
+        DB::Store_Reader store;
+        store.open((const char *)buffer->data(), serialized.size());
+        string header;
+        store >> header;
+        StringCountsTable loaded;
+        loaded.reconstitute(store, buffer);
+        BOOST_CHECK(loaded.isMapped());
+        checkEqual(loaded, expected);
+    }
+}
@@ -0,0 +1,95 @@
+/* swiss_hash_benchmark.cc                                         -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Benchmark of insertion, successful lookup and unsuccessful lookup of
+   random 64 bit keys (like row hashes) for SwissHash, LightweightHash and
+   std::unordered_map.  The largest table size defaults to 1M keys and can
+   be overridden with the SWISS_HASH_BENCHMARK_SIZE environment variable.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/swiss_hash.h"
+#include "mldb/utils/lightweight_hash.h"
+#include "mldb/arch/timers.h"
+#include <boost/test/unit_test.hpp>
+#include <unordered_map>
+#include <random>
+
+using namespace MLDB;
+using namespace std;
+
+
+namespace {
+
+struct Results {
+    double insertNs = 0;
+    double hitNs = 0;
+    double missNs = 0;
+};
+
+/** Time each operation over the keys, reporting nanoseconds per key.  The
+    checksum stops the lookups from being optimized away.
+*/
+template<typename Map>
+Results benchmark(const std::vector<uint64_t> & keys,
+                  const std::vector<uint64_t> & missing)
+{
+    Results result;
+    Map map;
+    uint64_t checksum = 0;
+
+    Timer timer;
+    for (size_t i = 0;  i < keys.size();  ++i)
+        map[keys[i]] = i;
+    result.insertNs = timer.elapsed_wall() * 1e9 / keys.size();
+
+    timer.restart();
+    for (auto k: keys)
+        checksum += map.find(k)->second;
+    result.hitNs = timer.elapsed_wall() * 1e9 / keys.size();
+
+    timer.restart();
+    for (auto k: missing)
+        checksum += map.count(k);
+    result.missNs = timer.elapsed_wall() * 1e9 / missing.size();
+
+    BOOST_CHECK_EQUAL(checksum, keys.size() * (keys.size() - 1) / 2);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(benchmark_hash_maps)
+{
+    size_t maxSize = 1000000;
+    if (getenv("SWISS_HASH_BENCHMARK_SIZE"))
+        maxSize = std::stoull(getenv("SWISS_HASH_BENCHMARK_SIZE"));
+
+    std::mt19937_64 rng(1);
+
+    cerr << "       size             map  insert ns  hit ns  miss ns" << endl;
+    for (size_t size = 1000;  size <= maxSize;  size *= 10) {
+        std::vector<uint64_t> keys(size), missing(size);
+        for (auto & k: keys)
+            k = rng() | 1;   // LightweightHash can't hold zero
+        for (auto & k: missing)
+            k = rng() | 1;
+
+        auto print = [&] (const char * name, const Results & r)
+            {
+                cerr << MLDB::format("%11zd %15s %10.1f %7.1f %8.1f\n",
+                                     size, name, r.insertNs, r.hitNs,
+                                     r.missNs);
+            };
+
+        print("SwissHash",
+              benchmark<SwissHash<uint64_t, uint64_t> >(keys, missing));
+        print("LightweightHash",
+              benchmark<LightweightHash<uint64_t, uint64_t> >(keys, missing));
+        print("unordered_map",
+              benchmark<std::unordered_map<uint64_t, uint64_t> >
+              (keys, missing));
+    }
+}
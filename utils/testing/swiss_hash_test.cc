@@ -0,0 +1,224 @@
+/* swiss_hash_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test program for the SIMD probed hash map and set.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#undef NDEBUG
+
+#include "mldb/utils/swiss_hash.h"
+#include <boost/test/unit_test.hpp>
+#include <unordered_map>
+#include <unordered_set>
+#include <random>
+#include <set>
+#include "live_counting_obj.h"
+
+using namespace MLDB;
+using namespace std;
+
+BOOST_AUTO_TEST_CASE(test_basics)
+{
+    SwissHash<int, int> h;
+    const SwissHash<int, int> & ch = h;
+
+    BOOST_CHECK_EQUAL(h.empty(), true);
+    BOOST_CHECK_EQUAL(h.size(), 0);
+    BOOST_CHECK_EQUAL(h.begin(), h.end());
+    BOOST_CHECK_EQUAL(ch.begin(), ch.end());
+    BOOST_CHECK_EQUAL(h.begin(), ch.end());
+    BOOST_CHECK_EQUAL(h.count(1), 0);
+    BOOST_CHECK(h.find(1) == h.end());
+
+    h.reserve(16);
+    BOOST_CHECK_GE(h.capacity(), 16);
+    BOOST_CHECK_EQUAL(h.size(), 0);
+    BOOST_CHECK_EQUAL(h.begin(), h.end());
+
+    h[1] = 1;
+
+    BOOST_CHECK_EQUAL(h[1], 1);
+    BOOST_CHECK_EQUAL(h.size(), 1);
+    BOOST_CHECK(h.begin() != h.end());
+    BOOST_CHECK_EQUAL(h.begin()->first, 1);
+    BOOST_CHECK_EQUAL(h.begin()->second, 1);
+    BOOST_CHECK_EQUAL(std::next(h.begin()), ch.end());
+    BOOST_CHECK_EQUAL(h.begin(), std::prev(ch.end()));
+
+    h[2] = 2;
+
+    // Zero is an ordinary key
+    h[0] = 0;
+
+    BOOST_CHECK_EQUAL(h[0], 0);
+    BOOST_CHECK_EQUAL(h[1], 1);
+    BOOST_CHECK_EQUAL(h[2], 2);
+    BOOST_CHECK_EQUAL(h.size(), 3);
+    BOOST_CHECK_EQUAL(++++++h.begin(), h.end());
+
+    auto res = h.insert(make_pair(2, 20));
+    BOOST_CHECK(!res.second);
+    BOOST_CHECK_EQUAL(res.first->second, 2);
+
+    res = h.insert(make_pair(3, 3));
+    BOOST_CHECK(res.second);
+    BOOST_CHECK_EQUAL(res.first->first, 3);
+
+    BOOST_CHECK_EQUAL(h.erase(2), 1);
+    BOOST_CHECK_EQUAL(h.erase(2), 0);
+    BOOST_CHECK_EQUAL(h.count(2), 0);
+    BOOST_CHECK_EQUAL(h.size(), 3);
+
+    auto it = h.erase(h.find(0));
+    BOOST_CHECK(it == h.end() || it->first != 0);
+    BOOST_CHECK_EQUAL(h.size(), 2);
+
+    SwissHash<int, int> h2 = h;
+    BOOST_CHECK_EQUAL(h2.size(), 2);
+    BOOST_CHECK_EQUAL(h2[1], 1);
+    BOOST_CHECK_EQUAL(h2[3], 3);
+
+    SwissHash<int, int> h3 = std::move(h2);
+    BOOST_CHECK_EQUAL(h3.size(), 2);
+    BOOST_CHECK_EQUAL(h2.size(), 0);
+    BOOST_CHECK_EQUAL(h3[3], 3);
+
+    h.clear();
+    BOOST_CHECK_EQUAL(h.size(), 0);
+    BOOST_CHECK_EQUAL(h.begin(), h.end());
+    BOOST_CHECK_EQUAL(h.count(1), 0);
+}
+
+/** Random operations, checked against std::unordered_map.  The keys are
+    drawn from a small range so that erasures and reinsertions happen
+    often, and a full table sees plenty of deleted slots.
+*/
+BOOST_AUTO_TEST_CASE(test_random_against_unordered_map)
+{
+    for (uint64_t range: { 10, 100, 1000, 100000 }) {
+        SwissHash<uint64_t, uint64_t> h;
+        std::unordered_map<uint64_t, uint64_t> ref;
+        std::mt19937 rng(range);
+
+        for (int i = 0;  i < 200000;  ++i) {
+            uint64_t key = rng() % range;
+            switch (rng() % 4) {
+            case 0:
+            case 1: {
+                auto r1 = h.insert(make_pair(key, uint64_t(i)));
+                auto r2 = ref.insert(make_pair(key, uint64_t(i)));
+                BOOST_REQUIRE_EQUAL(r1.second, r2.second);
+                BOOST_REQUIRE_EQUAL(r1.first->second, r2.first->second);
+                break;
+            }
+            case 2:
+                BOOST_REQUIRE_EQUAL(h.erase(key), ref.erase(key));
+                break;
+            case 3: {
+                auto it = h.find(key);
+                auto it2 = ref.find(key);
+                BOOST_REQUIRE_EQUAL(it == h.end(), it2 == ref.end());
+                if (it2 != ref.end())
+                    BOOST_REQUIRE_EQUAL(it->second, it2->second);
+                break;
+            }
+            }
+            BOOST_REQUIRE_EQUAL(h.size(), ref.size());
+        }
+
+        // Iteration visits each key exactly once
+        size_t n = 0;
+        for (auto & e: h) {
+            BOOST_REQUIRE_EQUAL(ref.at(e.first), e.second);
+            ++n;
+        }
+        BOOST_CHECK_EQUAL(n, ref.size());
+
+        // Backwards too
+        n = 0;
+        for (auto it = h.end();  it != h.begin();) {
+            --it;
+            ++n;
+        }
+        BOOST_CHECK_EQUAL(n, ref.size());
+
+        // Churn shouldn't make the table grow beyond what it needs
+        BOOST_CHECK_LE(h.capacity(), 4 * std::max<size_t>(range, 16));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_sorted_keys_iterate_in_order)
+{
+    // Keys whose hash is the identity come out in sorted order, as each
+    // home group is taken from the high bits
+    struct IdentityHash {
+        uint64_t operator () (uint64_t key) const { return key; }
+    };
+
+    SwissHash<uint64_t, int, std::pair<uint64_t, int>,
+              std::pair<const uint64_t, int>, IdentityHash> h;
+    std::mt19937_64 rng(1);
+    std::set<uint64_t> keys;
+    for (int i = 0;  i < 1000;  ++i)
+        keys.insert(rng());
+    h.reserve(keys.size());
+    for (auto k: keys)
+        h[k] = 1;
+
+    uint64_t last = 0;
+    int outOfOrder = 0;
+    for (auto & e: h) {
+        outOfOrder += e.first < last;
+        last = e.first;
+    }
+
+    // Only keys that spilled over into the next group can be out of order
+    BOOST_CHECK_LT(outOfOrder, 50);
+}
+
+BOOST_AUTO_TEST_CASE(test_object_lifetimes)
+{
+    constructed = destroyed = 0;
+    {
+        SwissHash<int, Obj> h;
+        for (int i = 0;  i < 1000;  ++i)
+            h[i] = i;
+        for (int i = 0;  i < 1000;  i += 2)
+            h.erase(i);
+        SwissHash<int, Obj> h2(h);
+        BOOST_CHECK_EQUAL(h2.size(), 500);
+        h.clear();
+    }
+    BOOST_CHECK_EQUAL(constructed, destroyed);
+}
+
+BOOST_AUTO_TEST_CASE(test_set)
+{
+    SwissHash_Set<int> s = { 1, 2, 3 };
+    BOOST_CHECK_EQUAL(s.size(), 3);
+    BOOST_CHECK(s.count(2));
+    BOOST_CHECK(!s.insert(2).second);
+    BOOST_CHECK(s.insert(0).second);
+    BOOST_CHECK_EQUAL(s.size(), 4);
+    BOOST_CHECK_EQUAL(*s.find(0), 0);
+    BOOST_CHECK(s.find(5) == s.end());
+
+    vector<int> more = { 4, 5, 1 };
+    BOOST_CHECK_EQUAL(s.insert(more.begin(), more.end()), 2);
+
+    std::set<int> contents(s.begin(), s.end());
+    BOOST_CHECK_EQUAL(contents.size(), 6);
+    BOOST_CHECK_EQUAL(*contents.begin(), 0);
+    BOOST_CHECK_EQUAL(*contents.rbegin(), 5);
+
+    BOOST_CHECK_EQUAL(s.erase(1), 1);
+    BOOST_CHECK_EQUAL(s.count(1), 0);
+
+    SwissHash_Set<std::string> strs;
+    strs.insert("hello");
+    strs.insert("world");
+    BOOST_CHECK(strs.count("hello"));
+    BOOST_CHECK(!strs.count("bonjour"));
+}
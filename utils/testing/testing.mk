@@ -28,10 +28,19 @@ $(TESTS)/runner_test $(TESTS)/runner_stress_test: $(BIN)/runner_test_helper
 $(eval $(call test,sink_test,runner utils,boost))
 
 $(eval $(call test,lightweight_hash_test,arch utils,boost))
+$(eval $(call test,swiss_hash_test,arch utils,boost))
+$(eval $(call test,swiss_hash_benchmark,arch utils,boost manual))
 $(eval $(call test,parse_context_test,utils arch,boost))
 
 $(eval $(call test,environment_test,utils arch,boost))
 $(eval $(call test,string_functions_test,arch utils,boost))
 $(eval $(call test,csv_parsing_test,arch utils,boost))
 $(eval $(call test,round_test,,boost))
+$(eval $(call test,top_n_test,,boost))
+$(eval $(call test,hnsw_index_test,arch base db,boost))
+$(eval $(call test,hnsw_index_benchmark,arch base db,boost manual))
+$(eval $(call test,lru_cache_test,,boost))
+$(eval $(call test,progress_test,progress types arch,boost))
+$(eval $(call test,string_counts_table_test,string_counts_table,boost))
+$(eval $(call test,sketches_test,utils arch,boost))
 $(eval $(call test,for_each_line_test,utils,boost))
@@ -0,0 +1,60 @@
+/* top_n_test.cc                                                   -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Test of the bounded top-n heap.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/top_n.h"
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+using namespace MLDB;
+using namespace std;
+
+
+BOOST_AUTO_TEST_CASE( test_top_n_matches_sort )
+{
+    std::mt19937 rng(1);
+    std::vector<int> values;
+    for (size_t i = 0;  i < 10000;  ++i)
+        values.push_back(rng() % 1000);
+
+    for (size_t n: { 0, 1, 7, 100, 9999, 10000, 20000 }) {
+        TopN<int> top(n);
+        for (int v: values)
+            top.add(v);
+
+        std::vector<int> expected = values;
+        std::sort(expected.begin(), expected.end());
+        expected.resize(std::min(n, expected.size()));
+
+        std::vector<int> result = top.extractSorted();
+        BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(),
+                                      expected.begin(), expected.end());
+        BOOST_CHECK_EQUAL(top.size(), 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_top_n_merge )
+{
+    // Fill several independently, as each thread would, then merge
+    std::vector<TopN<int, std::greater<int> > > parts(4, TopN<int, std::greater<int> >(5));
+    for (int i = 0;  i < 100;  ++i)
+        parts[i % 4].add(i);
+
+    TopN<int, std::greater<int> > top(5);
+    BOOST_CHECK(top.wouldKeep(-1));
+    for (auto & p: parts)
+        top.merge(std::move(p));
+
+    BOOST_CHECK(!top.wouldKeep(95));
+    BOOST_CHECK(top.wouldKeep(100));
+
+    std::vector<int> result = top.extractSorted();
+    std::vector<int> expected = { 99, 98, 97, 96, 95 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(),
+                                  expected.begin(), expected.end());
+}
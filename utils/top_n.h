@@ -0,0 +1,88 @@
+/* top_n.h                                                         -*- C++ -*-
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Bounded heap that keeps the first n values of a sort order.
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* TOP N                                                                     */
+/*****************************************************************************/
+
+/** Keeps the maxSize values that sort first of all of those added to it,
+    using memory proportional to maxSize rather than to the number of
+    values added.  This is used where a sort is followed by a limit, so
+    that all of the values don't need to be kept and sorted.
+
+    Values are kept in a heap with the last of the values kept at the top,
+    so adding a value that doesn't make the cut is a single comparison.
+    Several can be filled independently (for example, one per thread) and
+    then merged together.
+*/
+template<typename T, typename Compare = std::less<T> >
+struct TopN {
+    TopN(size_t maxSize = 0, Compare less = Compare())
+        : maxSize(maxSize), less(std::move(less))
+    {
+    }
+
+    size_t maxSize;
+    Compare less;
+    std::vector<T> heap;
+
+    size_t size() const
+    {
+        return heap.size();
+    }
+
+    /** Would the given value be kept if it were added?  This allows the
+        work of creating a value to be skipped where it won't be kept.
+    */
+    bool wouldKeep(const T & value) const
+    {
+        return heap.size() < maxSize
+            || (maxSize > 0 && less(value, heap.front()));
+    }
+
+    /// Add the value, keeping it only if it's in the first maxSize values
+    void add(T value)
+    {
+        if (heap.size() < maxSize) {
+            heap.emplace_back(std::move(value));
+            std::push_heap(heap.begin(), heap.end(), less);
+        }
+        else if (maxSize > 0 && less(value, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), less);
+            heap.back() = std::move(value);
+            std::push_heap(heap.begin(), heap.end(), less);
+        }
+    }
+
+    /// Add all of the values kept by other, which is left empty
+    void merge(TopN && other)
+    {
+        for (auto & v: other.heap)
+            add(std::move(v));
+        other.heap.clear();
+    }
+
+    /** Return the values kept in sorted order.  The TopN is left empty. */
+    std::vector<T> extractSorted()
+    {
+        std::sort_heap(heap.begin(), heap.end(), less);
+        std::vector<T> result;
+        result.swap(heap);
+        return result;
+    }
+};
+
+} // namespace MLDB
@@ -12,6 +12,7 @@ LIBUTILS_SOURCES := \
 	confidence_intervals.cc \
 	quadtree.cc \
 	for_each_line.cc \
+	sketches.cc \
 
 LIBUTILS_LINK := \
 	arch \
@@ -27,6 +28,7 @@ $(eval $(call set_compile_option,hash.cc,-fpermissive))
 
 $(eval $(call library,config,config.cc,boost_program_options))
 $(eval $(call library,progress,progress.cc,))
+$(eval $(call library,string_counts_table,string_counts_table.cc,arch base db cityhash types vfs))
 $(eval $(call library,json_diff,json_diff.cc json_utils.cc,jsoncpp value_description types utils highwayhash))
 
 # Runner Common
@@ -15,8 +15,7 @@
 #include "mldb/utils/compact_vector.h"
 #include "mldb/types/db/compact_vector_persistence.h"
 #include <iostream>
-#include <thread>
-#include <future>
+#include "mldb/base/parallel.h"
 
 namespace MLDB {
 
@@ -275,7 +274,6 @@ struct VantagePointTreeT {
 #endif
 
             std::unique_ptr<VantagePointTreeT> inside, outside;
-            std::thread insideThread, outsideThread;
 
             auto doInside = [&] ()
                 {
@@ -291,54 +289,27 @@ struct VantagePointTreeT {
                         outside.reset(createParallel(outsideObjects, distance, depth + 1));
                 };
 
-            std::packaged_task<void ()> insideTask(doInside), outsideTask(doOutside);
-            std::future<void> insideFuture, outsideFuture;
-
-            static constexpr int PARALLEL_MAX_DEPTH = 5;
-            static constexpr size_t PARALLEL_LIMIT = 10000;
-            static constexpr float PARALLEL_MAX_RATIO=10;
-
-            float ratio =
-                1.0 * std::max(insideObjects.size(), outsideObjects.size())
-                / std::min(insideObjects.size(), outsideObjects.size());
-
-            bool parallelInside
-                = isfinite(ratio)
-                && ratio < PARALLEL_MAX_RATIO
-                && insideObjects.size() >= PARALLEL_LIMIT
-                && depth <= PARALLEL_MAX_DEPTH;
-
-            bool parallelOutside
-                = isfinite(ratio)
-                && ratio < PARALLEL_MAX_RATIO
-                && outsideObjects.size() >= PARALLEL_LIMIT
-                && depth <= PARALLEL_MAX_DEPTH;
-
-            if (parallelInside) {
-                insideFuture = insideTask.get_future();
-                insideThread = std::thread(std::move(insideTask));
+            // The two halves are built as jobs on the thread pool, which
+            // the calling thread takes part in, so the recursion can go
+            // as deep as is useful without oversubscribing the machine.
+            // Small subtrees aren't worth the overhead of a job.
+            static constexpr size_t PARALLEL_LIMIT = 1000;
+
+            if (insideObjects.size() >= PARALLEL_LIMIT
+                && outsideObjects.size() >= PARALLEL_LIMIT) {
+                auto doHalf = [&] (size_t half)
+                    {
+                        if (half == 0)
+                            doInside();
+                        else doOutside();
+                    };
+                MLDB::parallelMap(0, 2, doHalf);
             }
-
-            if (parallelOutside) {
-                outsideFuture = outsideTask.get_future();
-                outsideThread = std::thread(std::move(outsideTask));
-            }
-
-            if (!parallelInside) {
+            else {
                 doInside();
-            }
-            if (!parallelOutside) {
                 doOutside();
             }
 
-            if (parallelInside) {
-                insideThread.join();
-                insideFuture.wait();
-            }
-            if (parallelOutside) {
-                outsideThread.join();
-                outsideFuture.wait();
-            }
 #if 0
             cerr << "depth = " << depth << " to insert " << objectsToInsert.size()
                  << " pivot items " << items.size()
@@ -11,6 +11,7 @@
 #include <bzlib.h>
 #include "mldb/base/exc_assert.h"
 #include <iostream>
+#include <cstring>
 
 
 using namespace std;
@@ -57,6 +58,9 @@ struct BzlibStreamCommon: public bz_stream {
     }
     
     int (*process) (bz_stream * stream, int flush) = nullptr;
+
+    /// Set once process() has returned BZ_STREAM_END
+    bool streamEnded = false;
     
     size_t pump(const char * data, size_t len, const OnData & onData,
                 int flushLevel)
@@ -90,8 +94,10 @@ struct BzlibStreamCommon: public bz_stream {
                 result += bytesWritten;
                 break;
 
-            case BZ_FINISH_OK:
             case BZ_STREAM_END:
+                streamEnded = true;
+                // fall through
+            case BZ_FINISH_OK:
                 if (bytesWritten)
                     onData(output, bytesWritten);
                 result += bytesWritten;
@@ -181,10 +187,17 @@ registerBzipCompressor("bzip2", {"bz2", "bzip2"});
 /* BZIP DECOMPRESSOR                                                         */
 /*****************************************************************************/
 
+/** Decompressor for bzip2.  A bzip2 file may be several streams one after
+    the other, as written by pbzip2 or by concatenating bzip2 files.
+*/
+
 struct BzipDecompressor: public Decompressor, public BzlibStreamCommon {
 
     typedef Decompressor::OnData OnData;
 
+    /// Set once we've been given any data
+    bool started = false;
+
     static int bz_decompress(bz_stream * stream, int flush)
     {
         ExcAssertEqual(flush, BZ_RUN);
@@ -196,10 +209,7 @@ struct BzipDecompressor: public Decompressor, public BzlibStreamCommon {
     BzipDecompressor()
     {
         //cerr << "creating decompressor" << endl;
-
-        int res = BZ2_bzDecompressInit(this, 0 /* verbosity */, 0 /* small */);
-        if (res != BZ_OK)
-            throw Exception("BZ2_decompressInit failed: " + bzerror(res));
+        init();
         this->process = &bz_decompress;
     }
 
@@ -208,21 +218,82 @@ struct BzipDecompressor: public Decompressor, public BzlibStreamCommon {
         BZ2_bzDecompressEnd(this);
     }
 
+    void init()
+    {
+        int res = BZ2_bzDecompressInit(this, 0 /* verbosity */, 0 /* small */);
+        if (res != BZ_OK)
+            throw Exception("BZ2_decompressInit failed: " + bzerror(res));
+    }
+
     virtual int64_t decompressedSize(const char * block, size_t blockLen,
                                      int64_t totalLen) const override
     {
         // TODO: can probably do better than this...
         return LENGTH_UNKNOWN;
     }
+
+    virtual int64_t frameLength(const char * block, size_t blockLen,
+                                bool & speculative) const override
+    {
+        // Each stream starts with "BZh", the block size and then the
+        // magic number of the first block, 0x314159265359.  We guess that
+        // the stream ends where that appears again; if the guess is wrong,
+        // the stream will be truncated and fail to decompress.  Splitting
+        // into the blocks themselves isn't possible, as they aren't
+        // aligned on bytes.
+        static const char MAGIC[] = "BZh01AY&SY";
+        static constexpr size_t MAGIC_LEN = sizeof(MAGIC) - 1;
+
+        auto isStreamStart = [] (const char * p)
+            {
+                return p[0] == 'B' && p[1] == 'Z' && p[2] == 'h'
+                    && p[3] >= '1' && p[3] <= '9'
+                    && memcmp(p + 4, MAGIC + 4, MAGIC_LEN - 4) == 0;
+            };
+
+        if (blockLen < MAGIC_LEN)
+            return LENGTH_INSUFFICIENT_DATA;
+        if (!isStreamStart(block))
+            return LENGTH_UNKNOWN;
+
+        speculative = true;
+        const char * e = block + blockLen;
+        for (const char * p = block + MAGIC_LEN;;  ++p) {
+            p = (const char *)memchr(p, 'B', e - p);
+            if (!p || e - p < MAGIC_LEN)
+                return LENGTH_INSUFFICIENT_DATA;
+            if (isStreamStart(p))
+                return p - block;
+        }
+    }
     
     virtual void decompress(const char * data, size_t len,
                             const OnData & onData) override
     {
-        pump(data, len, onData, BZ_RUN);
+        while (len > 0) {
+            if (streamEnded) {
+                // Another stream follows the one that finished
+                BZ2_bzDecompressEnd(this);
+                init();
+                streamEnded = false;
+            }
+
+            started = true;
+            pump(data, len, onData, BZ_RUN);
+            size_t used = len - avail_in;
+            data += used;
+            len -= used;
+        }
     }
     
     virtual void finish(const OnData & onData) override
     {
+        // Get out anything the decompressor is still holding on to
+        while (started && !streamEnded) {
+            size_t written = pump(0, 0, onData, BZ_RUN);
+            if (written == 0 && !streamEnded)
+                throw Exception("bzip2 stream is truncated");
+        }
     }
 };
 
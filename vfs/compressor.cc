@@ -118,6 +118,13 @@ Decompressor::
 {
 }
 
+int64_t
+Decompressor::
+frameLength(const char * block, size_t blockLen, bool & speculative) const
+{
+    return LENGTH_UNKNOWN;
+}
+
 Decompressor *
 Decompressor::
 create(const std::string & decompression)
@@ -132,7 +132,26 @@ struct Decompressor {
 
     static constexpr int64_t LENGTH_UNKNOWN = -1;
     static constexpr int64_t LENGTH_INSUFFICIENT_DATA = -2;
-    
+
+    /** Return the length of the compressed frame that starts at block,
+        where a frame is a unit of the compressed data that can be
+        decompressed by a fresh decompressor independently of what comes
+        before it, and the whole stream is its frames one after the other.
+        This is what allows a stream to be decompressed in parallel.
+
+        Returns a length > 0, LENGTH_UNKNOWN if the format (or this
+        stream) can't be split into frames, or LENGTH_INSUFFICIENT_DATA
+        if the end of the frame isn't within the block.
+
+        If the length is only a guess (for example, found by searching
+        for the magic number of the next frame), speculative is set to
+        true and the frame must be checked by decompressing it, which
+        must fail if the guess was wrong.  The default implementation
+        returns LENGTH_UNKNOWN.
+    */
+    virtual int64_t frameLength(const char * block, size_t blockLen,
+                                bool & speculative) const;
+
     /** Decompress the given data block, and write the result into the
         given buffer.
 
@@ -16,6 +16,9 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/filter_streams_registry.h"
 #include "compressor.h"
+#include "parallel_compressor.h"
+#include "parallel_decompressor.h"
+#include "uri_cache.h"
 #include <fstream>
 #include <mutex>
 #include <boost/iostreams/filtering_stream.hpp>
@@ -25,12 +28,14 @@
 #include <boost/version.hpp>
 #include <boost/lexical_cast.hpp>
 #include "mldb/arch/exception.h"
+#include "mldb/arch/profile_scope.h"
 #include <errno.h>
 #include <sstream>
 #include <thread>
 #include <unordered_map>
 #include "fs_utils.h"
 #include "mldb/base/exc_assert.h"
+#include "mldb/base/resource_usage.h"
 
 
 using namespace std;
@@ -195,6 +200,7 @@ struct BoostDecompressor {
                 return dataLength;  // we always consume all of the characters
             };
         
+        MLDB_PROFILE_SCOPE("vfs.read");
         while (n > 0) {
             ssize_t numRead = boost::iostreams::read(src, inbuf.data(), inbuf.size());
             if (numRead <= 0) {
@@ -352,11 +358,26 @@ bool ends_with(const std::string & str, const std::string & what)
         && result == str.size() - what.size();
 }
 
+/** Create the compressor for the given scheme.  If numThreads isn't one
+    and the scheme allows it, blocks of the stream are compressed in
+    parallel, with numThreads threads or one per CPU if it's zero.
+*/
+Compressor * createCompressor(const std::string & compression,
+                              int compressionLevel,
+                              int numThreads)
+{
+    if (numThreads != 1 && ParallelCompressor::supports(compression))
+        return new ParallelCompressor(compression, compressionLevel,
+                                      numThreads);
+    return Compressor::create(compression, compressionLevel);
+}
+
 void addCompression(streambuf & buf,
                     boost::iostreams::filtering_ostream & stream,
                     const std::string & resource,
                     const std::string & compression,
-                    int compressionLevel)
+                    int compressionLevel,
+                    int numThreads)
 {
     using namespace boost::iostreams;
 
@@ -365,7 +386,7 @@ void addCompression(streambuf & buf,
     }
     else if (compression != "") {
         Compressor * compressor
-            = Compressor::create(compression, compressionLevel);
+            = createCompressor(compression, compressionLevel, numThreads);
         if (!compressor)
             throw MLDB::Exception("unknown filter compression " + compression);
         stream.push(BoostCompressor(compressor));
@@ -375,7 +396,8 @@ void addCompression(streambuf & buf,
             = Compressor::filenameToCompression(resource);
         if (compressionFromFilename != "") {
             Compressor * compressor
-                = Compressor::create(compressionFromFilename, compressionLevel);
+                = createCompressor(compressionFromFilename, compressionLevel,
+                                   numThreads);
             if (!compressor)
                 throw MLDB::Exception("unknown filter compression " + compression);
             stream.push(BoostCompressor(compressor));
@@ -397,8 +419,14 @@ void addCompression(streambuf & buf,
     it = options.find("compressionLevel");
     if (it != options.end())
         compressionLevel = boost::lexical_cast<int>(it->second);
+
+    int numThreads = 1;
+    it = options.find("compressionThreads");
+    if (it != options.end())
+        numThreads = boost::lexical_cast<int>(it->second);
     
-    addCompression(buf, stream, resource, compression, compressionLevel);
+    addCompression(buf, stream, resource, compression, compressionLevel,
+                   numThreads);
 }
 
 
@@ -767,6 +795,153 @@ operator = (filter_istream && other)
     return *this;
 }
 
+namespace {
+
+/** Stream buffer that passes reads through to another one, counting the
+    bytes that come out of it.  The count is added to the resource usage
+    that was current when the stream was opened once the stream is closed,
+    so that reading doesn't need to take its lock.
+*/
+struct CountingStreambuf: public std::streambuf {
+    CountingStreambuf(std::streambuf * source,
+                      std::shared_ptr<ResourceUsage> usage,
+                      std::string scheme)
+        : source(source), usage(std::move(usage)),
+          scheme(std::move(scheme)), buffer(65536), bytesRead(0)
+    {
+        setg(buffer.data(), buffer.data(), buffer.data());
+    }
+
+    ~CountingStreambuf()
+    {
+        usage->addBytesRead(scheme, bytesRead);
+    }
+
+    virtual int_type underflow()
+    {
+        std::streamsize n = source->sgetn(buffer.data(), buffer.size());
+        if (n <= 0)
+            return traits_type::eof();
+        bytesRead += n;
+        setg(buffer.data(), buffer.data(), buffer.data() + n);
+        return traits_type::to_int_type(buffer[0]);
+    }
+
+    virtual std::streamsize xsgetn(char * s, std::streamsize n)
+    {
+        // Anything still buffered first, then straight from the source
+        std::streamsize done = std::min<std::streamsize>(n, egptr() - gptr());
+        std::copy(gptr(), gptr() + done, s);
+        gbump(done);
+        if (done < n) {
+            std::streamsize got = source->sgetn(s + done, n - done);
+            if (got > 0) {
+                bytesRead += got;
+                done += got;
+            }
+        }
+        return done;
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which)
+    {
+        std::streamsize buffered = egptr() - gptr();
+        if (off == 0 && dir == std::ios_base::cur) {
+            // tellg(); don't throw away what we have buffered
+            pos_type pos = source->pubseekoff(0, dir, which);
+            if (pos == pos_type(off_type(-1)))
+                return pos;
+            return pos - off_type(buffered);
+        }
+        if (dir == std::ios_base::cur)
+            off -= buffered;
+        setg(buffer.data(), buffer.data(), buffer.data());
+        return source->pubseekoff(off, dir, which);
+    }
+
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+    {
+        setg(buffer.data(), buffer.data(), buffer.data());
+        return source->pubseekpos(pos, which);
+    }
+
+    std::streambuf * source;
+    std::shared_ptr<ResourceUsage> usage;
+    std::string scheme;
+    std::vector<char> buffer;
+    uint64_t bytesRead;
+};
+
+/** If there is a current resource usage, make the handler count the bytes
+    read through it against the usage.  Mapped files are counted in full
+    when they are opened, as their reads can't be seen.
+*/
+UriHandler
+countBytesRead(UriHandler handler, const std::string & scheme)
+{
+    ResourceUsage * usage = ResourceUsage::current();
+    if (!usage || !handler.buf)
+        return handler;
+
+    if (handler.options.mapped) {
+        usage->addBytesRead(scheme, handler.options.mappedSize);
+        return handler;
+    }
+
+    auto counting = std::make_shared<CountingStreambuf>
+        (handler.buf, usage->shared_from_this(), scheme);
+    handler.buf = counting.get();
+    handler.bufOwnership
+        = std::make_shared<std::pair<std::shared_ptr<void>,
+                                     std::shared_ptr<CountingStreambuf> > >
+        (std::move(handler.bufOwnership), std::move(counting));
+    return handler;
+}
+
+/** Get the handler to read scheme://resource.  Remote objects are read
+    through the local disk cache if it's turned on (see uri_cache.h), in
+    which case the handler reads the cached file.
+*/
+UriHandler
+getReadHandler(const std::string & scheme,
+               const std::string & resource,
+               const std::map<std::string, std::string> & options,
+               const OnUriHandlerException & onException)
+{
+    auto cache = UriCache::getDefault();
+    auto cacheIt = options.find("cache");
+    bool useCache = cache && scheme != "file" && scheme != "mem"
+        && (cacheIt == options.end() || cacheIt->second != "false");
+
+    if (useCache) {
+        std::string uri = scheme + "://" + resource;
+        FsObjectInfo info;
+        try {
+            info = tryGetUriObjectInfo(uri);
+        } catch (const std::exception & exc) {
+            // Not something we can get the info of; read it directly
+        }
+
+        std::string path;
+        if (info)
+            path = cache->getFile(uri, info);
+        if (!path.empty()) {
+            UriHandler handler
+                = getUriHandler("file")("file", path, ios::in, options,
+                                        onException);
+            handler.info = std::make_shared<FsObjectInfo>(std::move(info));
+            return countBytesRead(std::move(handler), "file");
+        }
+    }
+
+    return countBytesRead(getUriHandler(scheme)(scheme, resource, ios::in,
+                                                options, onException),
+                          scheme);
+}
+
+} // file scope
+
 void
 filter_istream::
 open(const std::string & uri,
@@ -786,9 +961,10 @@ open(const std::string & uri,
         }
     };
     auto options = createOptions(mode, compression, -1);
-    UriHandler handler = handlerFactory(scheme, resource, mode,
-                                        options,
-                                        onException);
+    UriHandler handler
+        = mode == ios::in
+        ? getReadHandler(scheme, resource, options, onException)
+        : handlerFactory(scheme, resource, mode, options, onException);
     
     openFromHandler(handler, resource, options);
 }
@@ -812,14 +988,13 @@ open(const std::string & uri,
     string scheme, resource;
     std::tie(scheme, resource) = getScheme(uri);
 
-    const auto & handlerFactory = getUriHandler(scheme);
     auto onException = [&](const exception_ptr & excPtr) {
         if (!this->deferredFailure.exchange(true)) {
             // only take first exception
             this->deferredExcPtr = excPtr;
         }
     };
-    UriHandler handler = handlerFactory(scheme, resource, ios::in, options, onException);
+    UriHandler handler = getReadHandler(scheme, resource, options, onException);
     openFromHandler(handler, resource, options);
 }
 
@@ -868,12 +1043,12 @@ openFromStreambuf(std::streambuf * buf,
     if (compression == "") {
         std::string compression = Compressor::filenameToCompression(resource);
         if (compression != "") {
-            new_stream->push(BoostDecompressor(Decompressor::create(compression)));
+            new_stream->push(BoostDecompressor(new ParallelDecompressor(compression)));
         }
     } else if (compression == "none") {
         // no-op
     } else {
-        new_stream->push(BoostDecompressor(Decompressor::create(compression)));
+        new_stream->push(BoostDecompressor(new ParallelDecompressor(compression)));
     }
 
     if (!new_stream->empty()) {
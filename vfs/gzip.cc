@@ -11,6 +11,7 @@
 #include <zlib.h>
 #include "mldb/base/exc_assert.h"
 #include <iostream>
+#include <cstring>
 
 
 using namespace std;
@@ -35,6 +36,9 @@ struct ZlibStreamCommon: public z_stream {
     }
     
     int (*process) (z_streamp stream, int flush) = nullptr;
+
+    /// Set once process() has returned Z_STREAM_END
+    bool streamEnded = false;
     
     size_t pump(const char * data, size_t len, const OnData & onData,
                 int flushLevel)
@@ -70,6 +74,7 @@ struct ZlibStreamCommon: public z_stream {
                 if (bytesWritten)
                     onData(output, bytesWritten);
                 result += bytesWritten;
+                streamEnded = true;
                 return result;
 
             default:
@@ -199,6 +204,13 @@ struct GzipHeaderReader {
           
     {
     }
+
+    /// Get ready to read the header of another member
+    void reset()
+    {
+        *this = GzipHeaderReader();
+        out = (char *)&header;
+    }
     
     bool process(char c)
     {
@@ -304,10 +316,23 @@ struct GzipHeaderReader {
     std::string * buf = nullptr;
 };
 
+/** Decompressor for gzip.  A gzip file may be several members one after
+    the other, each with its own header and trailer, as written by bgzip
+    or by concatenating gzip files; anything after a member that doesn't
+    start like a gzip header is ignored, as the gzip tool does.
+*/
+
 struct GzipDecompressor: public Decompressor, public ZlibStreamCommon {
 
     GzipHeaderReader header;
 
+    /// Number of bytes of the trailer (CRC and length) of the member that
+    /// has just finished that are still to be skipped.
+    int trailerRemaining = 0;
+
+    /// Set once we're past the last member, and ignoring the rest.
+    bool ignoreRest = false;
+
     typedef Decompressor::OnData OnData;
     
     GzipDecompressor()
@@ -328,26 +353,103 @@ struct GzipDecompressor: public Decompressor, public ZlibStreamCommon {
     {
         return LENGTH_UNKNOWN;
     }
+
+    virtual int64_t frameLength(const char * block, size_t blockLen,
+                                bool & speculative) const override
+    {
+        // Header, an empty deflate block and the trailer
+        static constexpr size_t MIN_MEMBER_LENGTH = 20;
+
+        const unsigned char * p = (const unsigned char *)block;
+        const unsigned char * e = p + blockLen;
+
+        if (blockLen < MIN_MEMBER_LENGTH)
+            return LENGTH_INSUFFICIENT_DATA;
+        if (p[0] != 0x1f || p[1] != 0x8b || p[2] != 8)
+            return LENGTH_UNKNOWN;
+
+        // bgzip (BGZF) puts the length of each member in a 'BC' subfield
+        // of the extra field
+        if (p[3] & GzipHeaderReader::FEXTRA) {
+            size_t extraEnd = 12 + (p[10] | (p[11] << 8));
+            if (blockLen < extraEnd)
+                return LENGTH_INSUFFICIENT_DATA;
+            for (size_t i = 12;  i + 4 <= extraEnd;) {
+                size_t subfieldLen = p[i + 2] | (p[i + 3] << 8);
+                if (p[i] == 'B' && p[i + 1] == 'C' && subfieldLen == 2
+                    && i + 6 <= extraEnd) {
+                    speculative = false;
+                    return (p[i + 4] | (p[i + 5] << 8)) + 1;
+                }
+                i += 4 + subfieldLen;
+            }
+        }
+
+        // Otherwise, guess that the member ends where something that
+        // looks like the header of the next one starts (magic number,
+        // deflate and no reserved flags).  If the guess is wrong, the
+        // member will be truncated and fail to decompress.
+        speculative = true;
+        for (const unsigned char * q = p + MIN_MEMBER_LENGTH;;  ++q) {
+            q = (const unsigned char *)memchr(q, 0x1f, e - q);
+            if (!q || e - q < 4)
+                return LENGTH_INSUFFICIENT_DATA;
+            if (q[1] == 0x8b && q[2] == 8 && (q[3] & 0xe0) == 0)
+                return q - p;
+        }
+    }
     
     virtual void decompress(const char * data, size_t len,
                             const OnData & onData) override
     {
-        size_t headerDone = 0;
-        if (!header.done()) {
-            headerDone = header.process(data, len);
-            //cerr << "header used " << headerDone << " characters" << endl;
-            if (headerDone == len)
-                return;
-            ExcAssert(header.done());
-        }
+        while (len > 0 && !ignoreRest) {
+            if (trailerRemaining > 0) {
+                size_t n = std::min<size_t>(trailerRemaining, len);
+                trailerRemaining -= n;
+                data += n;
+                len -= n;
+                continue;
+            }
 
-        pump(data + headerDone,
-             len - headerDone, onData,
-             Z_NO_FLUSH);
+            if (streamEnded) {
+                // Previous member is finished; is there another?
+                if ((unsigned char)data[0] != 0x1f) {
+                    ignoreRest = true;
+                    break;
+                }
+                header.reset();
+                int res = inflateReset(this);
+                if (res != Z_OK)
+                    throw Exception("inflateReset failed");
+                streamEnded = false;
+            }
+
+            if (!header.done()) {
+                size_t headerDone = header.process(data, len);
+                //cerr << "header used " << headerDone << " characters" << endl;
+                data += headerDone;
+                len -= headerDone;
+                continue;
+            }
+
+            pump(data, len, onData, Z_NO_FLUSH);
+            size_t used = len - avail_in;
+            data += used;
+            len -= used;
+
+            if (streamEnded)
+                trailerRemaining = 8;
+        }
     }
     
     virtual void finish(const OnData & onData) override
     {
+        if (ignoreRest)
+            return;
+        if (trailerRemaining > 0)
+            throw Exception("gzip stream truncated in the trailer of a member");
+        if (streamEnded)
+            return;  // finished on the boundary between two members
         pump(0, 0, onData, Z_FINISH);
     }
 };
@@ -13,6 +13,7 @@
 #include "mldb/types/annotated_exception.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/vfs/exception_ptr.h"
+#include "mldb/vfs/ranged_streambuf.h"
 #include <chrono>
 #include <future>
 #include "mldb/ext/concurrentqueue/blockingconcurrentqueue.h"
@@ -372,6 +373,66 @@ makeHttpStreamingDownload(const std::string & uri,
     return { std::move(result), convertHeaderToInfo(header) };
 }
 
+/** Open the URI for random access with Range requests, if the server
+    says that it supports them.  Returns a null pointer otherwise, in
+    which case the caller streams it instead.
+*/
+static std::pair<std::unique_ptr<std::streambuf>, FsObjectInfo>
+makeHttpRangedDownload(const std::string & uri,
+                       const FsObjectInfo & info,
+                       const RangedReadOptions & options)
+{
+    auto it = info.objectMetadata.find("accept-ranges");
+    if (!info.exists || info.size < 0
+        || it == info.objectMetadata.end() || it->second != "bytes") {
+        return { nullptr, info };
+    }
+
+    auto proxy = std::make_shared<HttpRestProxy>(uri);
+
+    auto fetch = [proxy, uri] (uint64_t offset, uint64_t length)
+        {
+            if (length == 0)
+                return std::string();
+
+            RestParams headers
+                = { { "range", "bytes=" + to_string(offset) + "-"
+                      + to_string(offset + length - 1) } };
+
+            HttpRestProxy::Response resp;
+            for (unsigned attempt = 0;  attempt < 5;  ++attempt) {
+                if (attempt != 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100 * attempt + random() % 100));
+
+                resp = proxy->perform("GET", "", HttpRestProxy::Content(),
+                                      {}, headers, -1 /* timeout */,
+                                      false /* exceptions */,
+                                      nullptr, nullptr,
+                                      true /* follow redirects */);
+                if (resp.errorCode() == 0 && resp.code() < 500)
+                    break;
+            }
+
+            if (resp.code() == 206)
+                return resp.body();
+
+            // A server may ignore the range if it covers the whole resource
+            if (resp.code() == 200 && offset == 0
+                && resp.body().size() >= length)
+                return resp.body().substr(0, length);
+
+            throw AnnotatedException
+                (400, "HTTP code " + to_string(resp.code())
+                 + " reading bytes " + to_string(offset) + "-"
+                 + to_string(offset + length) + " of " + uri
+                 + "\n\n" + resp.errorMessage());
+        };
+
+    std::unique_ptr<std::streambuf> result
+        (new RangedReadStreambuf(info.size, fetch, options));
+    return { std::move(result), info };
+}
+
 struct HttpUrlFsHandler: UrlFsHandler {
     HttpRestProxy proxy;
 
@@ -503,9 +564,26 @@ struct RegisterHttpHandler {
         string bucket(resource, 0, pos);
 
         if (mode == ios::in) {
+            std::string uri = scheme + "://" + resource;
+
+            RangedReadOptions rangedOptions;
+            if (parseRangedReadOptions(options, rangedOptions)) {
+                HttpUrlFsHandler fs;
+                auto sb_info = makeHttpRangedDownload
+                    (uri, fs.getInfo(Url(uri)), rangedOptions);
+                if (sb_info.first) {
+                    std::shared_ptr<std::streambuf> buf(sb_info.first.release());
+                    UriHandlerOptions handlerOptions;
+                    handlerOptions.isForwardSeekable = true;
+                    handlerOptions.isRandomSeekable = true;
+                    return UriHandler(buf.get(), buf, sb_info.second,
+                                      handlerOptions);
+                }
+                // The server doesn't do ranges; stream it instead
+            }
+
             std::pair<std::unique_ptr<std::streambuf>, FsObjectInfo> sb_info
-                = makeHttpStreamingDownload(scheme+"://"+resource, options,
-                                            onException);
+                = makeHttpStreamingDownload(uri, options, onException);
             std::shared_ptr<std::streambuf> buf(sb_info.first.release());
             return UriHandler(buf.get(), buf, sb_info.second);
         }
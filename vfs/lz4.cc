@@ -331,12 +331,13 @@ struct Lz4Decompressor: public Decompressor {
     virtual void decompress(const char * data, size_t len,
                               const OnData & onData) override
     {
-        if (!cur) {
-            throw Exception("Extra junk at end of compressed lz4 data");
-        }
-
         size_t done = 0;
         while (done < len) {
+            if (state == FINISHED) {
+                // Another frame follows the one that finished
+                startFrame();
+            }
+
             size_t toRead = std::min<size_t>(limit - cur, len - done);
             std::memcpy(cur, data + done, toRead);
             done += toRead;
@@ -456,6 +457,15 @@ struct Lz4Decompressor: public Decompressor {
         }
     }
 
+    void startFrame()
+    {
+        if (streamChecksumState) {
+            XXH32_freeState(streamChecksumState);
+            streamChecksumState = nullptr;
+        }
+        setCur(HEADER, header);
+    }
+
     enum State {
         HEADER,
         BLOCK_HEADER,
@@ -0,0 +1,136 @@
+/** parallel_compressor.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Compressor that compresses blocks of a stream in parallel.
+*/
+
+#include "parallel_compressor.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/base/exc_assert.h"
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARALLEL COMPRESSOR                                                       */
+/*****************************************************************************/
+
+ParallelCompressor::
+ParallelCompressor(const std::string & compression,
+                   int level,
+                   int numThreads,
+                   size_t blockSize)
+    : compression(compression),
+      level(level),
+      numThreads(numThreads > 0 ? numThreads : numCpus()),
+      blockSize(blockSize)
+{
+    ExcAssertGreater(blockSize, 0);
+    if (!supports(compression))
+        throw Exception("compression " + compression
+                        + " can't be compressed in parallel");
+    current.reserve(blockSize);
+}
+
+ParallelCompressor::
+~ParallelCompressor()
+{
+}
+
+void
+ParallelCompressor::
+compress(const char * data, size_t len, const OnData & onData)
+{
+    while (len > 0) {
+        size_t toCopy = std::min(len, blockSize - current.size());
+        current.append(data, toCopy);
+        data += toCopy;
+        len -= toCopy;
+
+        if (current.size() == blockSize) {
+            blocks.emplace_back(std::move(current));
+            current = std::string();
+            current.reserve(blockSize);
+            if (blocks.size() >= numThreads)
+                compressBlocks(onData);
+        }
+    }
+}
+
+void
+ParallelCompressor::
+flush(FlushLevel flushLevel, const OnData & onData)
+{
+    if (flushLevel == FLUSH_NONE)
+        return;
+
+    // Finish the frame we're on so that everything written so far can
+    // be decompressed
+    if (!current.empty()) {
+        blocks.emplace_back(std::move(current));
+        current = std::string();
+    }
+    compressBlocks(onData);
+}
+
+void
+ParallelCompressor::
+finish(const OnData & onData)
+{
+    // An empty stream still needs a frame to be valid
+    if (!current.empty() || (!anyFrames && blocks.empty())) {
+        blocks.emplace_back(std::move(current));
+        current = std::string();
+    }
+    compressBlocks(onData);
+}
+
+bool
+ParallelCompressor::
+supports(const std::string & compression)
+{
+    return compression == "gzip" || compression == "bzip2"
+        || compression == "zstd" || compression == "lz4";
+}
+
+void
+ParallelCompressor::
+compressBlocks(const OnData & onData)
+{
+    std::vector<std::string> frames(blocks.size());
+
+    auto doBlock = [&] (size_t i)
+        {
+            auto onOutput = [&] (const char * data, size_t len)
+                {
+                    frames[i].append(data, len);
+                    return len;
+                };
+
+            std::unique_ptr<Compressor> compressor
+                (Compressor::create(compression, level));
+            if (!blocks[i].empty())
+                compressor->compress(blocks[i].data(), blocks[i].size(),
+                                     onOutput);
+            compressor->finish(onOutput);
+            blocks[i] = std::string();
+        };
+
+    parallelMap(0, blocks.size(), doBlock, numThreads);
+
+    for (auto & frame: frames) {
+        size_t done = 0;
+        while (done < frame.size())
+            done += onData(frame.data() + done, frame.size() - done);
+        anyFrames = true;
+    }
+
+    blocks.clear();
+}
+
+} // namespace MLDB
@@ -0,0 +1,77 @@
+/** parallel_compressor.h                                         -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Compressor that compresses blocks of a stream in parallel.
+*/
+
+#pragma once
+
+#include "compressor.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARALLEL COMPRESSOR                                                       */
+/*****************************************************************************/
+
+/** Compressor that wraps one of the registered compressors, and cuts the
+    stream into blocks which are each compressed into a frame of their own
+    (a gzip member, a zstd or lz4 frame or a bzip2 stream) by a fresh
+    compressor, with several blocks compressed at the same time.  The
+    frames are written in order, one after the other, which the tools for
+    each format and the matching decompressors (and ParallelDecompressor)
+    read as a single stream.
+
+    The output is a little bigger than with a single compressor, as each
+    block starts with an empty dictionary.
+*/
+
+struct ParallelCompressor: public Compressor {
+
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024;
+
+    /** Create a compressor for the given scheme and level that uses up to
+        numThreads threads (or one per CPU if it's zero or less).
+    */
+    ParallelCompressor(const std::string & compression,
+                       int level,
+                       int numThreads,
+                       size_t blockSize = DEFAULT_BLOCK_SIZE);
+
+    virtual ~ParallelCompressor();
+
+    virtual void compress(const char * data, size_t len,
+                          const OnData & onData) override;
+
+    virtual void flush(FlushLevel flushLevel, const OnData & onData) override;
+
+    virtual void finish(const OnData & onData) override;
+
+    /** Can the given compression scheme be compressed in parallel?  It
+        can if a stream of several frames one after the other is valid
+        and is read in full by its decompressor.
+    */
+    static bool supports(const std::string & compression);
+
+private:
+    /// Compress the blocks that are waiting, and write them out in order
+    void compressBlocks(const OnData & onData);
+
+    std::string compression;
+    int level;
+    int numThreads;
+    size_t blockSize;
+
+    /// Blocks that are full and waiting to be compressed
+    std::vector<std::string> blocks;
+
+    /// Block that is being filled
+    std::string current;
+
+    /// Have we written out any frames?
+    bool anyFrames = false;
+};
+
+} // namespace MLDB
@@ -0,0 +1,208 @@
+/** parallel_decompressor.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Decompressor that decompresses the frames of a stream in parallel.
+*/
+
+#include "parallel_decompressor.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/exc_assert.h"
+#include <exception>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARALLEL DECOMPRESSOR                                                     */
+/*****************************************************************************/
+
+namespace {
+
+void passOn(const char * data, size_t len,
+            const Decompressor::OnData & onData)
+{
+    size_t done = 0;
+    while (done < len)
+        done += onData(data + done, len - done);
+}
+
+} // file scope
+
+ParallelDecompressor::
+ParallelDecompressor(const std::string & compression,
+                     size_t windowSize)
+    : compression(compression),
+      windowSize(windowSize),
+      splitter(Decompressor::create(compression)),
+      nextSplit(windowSize)
+{
+    ExcAssertGreater(windowSize, 0);
+}
+
+ParallelDecompressor::
+~ParallelDecompressor()
+{
+}
+
+int64_t
+ParallelDecompressor::
+decompressedSize(const char * block, size_t blockLen,
+                 int64_t totalLen) const
+{
+    return splitter->decompressedSize(block, blockLen, totalLen);
+}
+
+int64_t
+ParallelDecompressor::
+frameLength(const char * block, size_t blockLen, bool & speculative) const
+{
+    return splitter->frameLength(block, blockLen, speculative);
+}
+
+void
+ParallelDecompressor::
+decompress(const char * data, size_t len, const OnData & onData)
+{
+    if (serial) {
+        serial->decompress(data, len, onData);
+        return;
+    }
+
+    started = started || len > 0;
+    buffered.append(data, len);
+
+    // Don't hold on to the data of a stream that can't be split; its
+    // first few bytes are enough to know
+    static constexpr size_t FORMAT_CHECK_LENGTH = 64;
+    if (!checkedFormat && buffered.size() >= FORMAT_CHECK_LENGTH) {
+        checkedFormat = true;
+        bool speculative = false;
+        if (splitter->frameLength(buffered.data(), FORMAT_CHECK_LENGTH,
+                                  speculative) == LENGTH_UNKNOWN) {
+            switchToSerial(0, onData);
+            return;
+        }
+    }
+
+    if (buffered.size() >= nextSplit) {
+        decompressFrames(onData, false /* final */);
+        nextSplit = buffered.size() + windowSize;
+    }
+}
+
+void
+ParallelDecompressor::
+finish(const OnData & onData)
+{
+    // With no data at all, let the decompressor decide if that's OK
+    if (!started && !serial)
+        serial.reset(Decompressor::create(compression));
+
+    if (!serial)
+        decompressFrames(onData, true /* final */);
+    if (serial)
+        serial->finish(onData);
+}
+
+void
+ParallelDecompressor::
+decompressFrames(const OnData & onData, bool final)
+{
+    struct Frame {
+        size_t start;
+        size_t length;
+        bool speculative;
+        std::string output;
+        std::exception_ptr error;
+    };
+
+    std::vector<Frame> frames;
+
+    size_t pos = 0;
+    bool splittable = true;
+    while (pos < buffered.size()) {
+        bool speculative = false;
+        int64_t frameLen
+            = splitter->frameLength(buffered.data() + pos,
+                                    buffered.size() - pos,
+                                    speculative);
+        if (frameLen == LENGTH_UNKNOWN) {
+            splittable = false;
+            break;
+        }
+        if (frameLen == LENGTH_INSUFFICIENT_DATA
+            || frameLen > buffered.size() - pos)
+            break;
+        frames.push_back({ pos, (size_t)frameLen, speculative });
+        pos += frameLen;
+    }
+
+    if (final && splittable && pos < buffered.size()) {
+        // Whatever is left must be a single, last frame.  It starts where
+        // the previous frame ended, so any error in it is a real one.
+        frames.push_back({ pos, buffered.size() - pos, false });
+        pos = buffered.size();
+    }
+
+    // A frame that is bigger than the window is too big to be worth
+    // waiting for
+    if (frames.empty() && (!splittable || buffered.size() >= windowSize)) {
+        switchToSerial(0, onData);
+        return;
+    }
+
+    auto doFrame = [&] (size_t i)
+        {
+            Frame & frame = frames[i];
+            auto onOutput = [&] (const char * data, size_t len)
+                {
+                    frame.output.append(data, len);
+                    return len;
+                };
+            try {
+                std::unique_ptr<Decompressor> decompressor
+                    (Decompressor::create(compression));
+                decompressor->decompress(buffered.data() + frame.start,
+                                         frame.length, onOutput);
+                decompressor->finish(onOutput);
+            } catch (...) {
+                frame.error = std::current_exception();
+            }
+        };
+
+    parallelMap(0, frames.size(), doFrame);
+
+    for (Frame & frame: frames) {
+        if (frame.error) {
+            if (!frame.speculative)
+                std::rethrow_exception(frame.error);
+            // The guess at where it ended was wrong.  The frame does start
+            // at a real boundary, as all frames before it were OK.
+            switchToSerial(frame.start, onData);
+            return;
+        }
+        passOn(frame.output.data(), frame.output.size(), onData);
+        frame.output = std::string();
+    }
+
+    buffered.erase(0, pos);
+
+    if (!splittable)
+        switchToSerial(0, onData);
+}
+
+void
+ParallelDecompressor::
+switchToSerial(size_t start, const OnData & onData)
+{
+    serial.reset(Decompressor::create(compression));
+    serial->decompress(buffered.data() + start, buffered.size() - start,
+                       onData);
+    buffered = std::string();
+}
+
+} // namespace MLDB
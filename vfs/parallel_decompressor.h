@@ -0,0 +1,87 @@
+/** parallel_decompressor.h                                       -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Decompressor that decompresses the frames of a stream in parallel.
+*/
+
+#pragma once
+
+#include "compressor.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARALLEL DECOMPRESSOR                                                     */
+/*****************************************************************************/
+
+/** Decompressor that wraps one of the registered decompressors, and uses
+    its frameLength() to split the compressed stream into frames that are
+    decompressed at the same time, passing on the output in order.  This
+    works for multi-frame zstd (pzstd), multi-member gzip (bgzip or
+    concatenated files) and multi-stream bzip2 (pbzip2).
+
+    Compressed data is buffered up until there is a window of it, which is
+    split into frames; a frame that isn't complete at the end of the window
+    is kept for the next one.  If the stream can't be split into frames (a
+    plain gzip file is a single member, for example) or a guess at where a
+    frame ends turns out to be wrong, the rest of the stream goes through a
+    single decompressor as normal.
+*/
+
+struct ParallelDecompressor: public Decompressor {
+
+    static constexpr size_t DEFAULT_WINDOW_SIZE = 8 * 1024 * 1024;
+
+    ParallelDecompressor(const std::string & compression,
+                         size_t windowSize = DEFAULT_WINDOW_SIZE);
+
+    virtual ~ParallelDecompressor();
+
+    virtual int64_t decompressedSize(const char * block, size_t blockLen,
+                                     int64_t totalLen) const override;
+
+    virtual int64_t frameLength(const char * block, size_t blockLen,
+                                bool & speculative) const override;
+
+    virtual void decompress(const char * data, size_t len,
+                            const OnData & onData) override;
+
+    virtual void finish(const OnData & onData) override;
+
+private:
+    /** Split what is buffered into frames and decompress them.  If final
+        is true, there is no more data and whatever is left over is the
+        last frame.
+    */
+    void decompressFrames(const OnData & onData, bool final);
+
+    /** Pass everything from offset start of the buffered data to a single
+        decompressor, which will be used for the rest of the stream.
+    */
+    void switchToSerial(size_t start, const OnData & onData);
+
+    std::string compression;
+    size_t windowSize;
+
+    /// Decompressor used to find the frames
+    std::unique_ptr<Decompressor> splitter;
+
+    /// Decompressor for the rest of the stream, once we stop splitting it
+    std::unique_ptr<Decompressor> serial;
+
+    /// Compressed data not yet decompressed, which starts on a frame
+    std::string buffered;
+
+    /// Size of buffered at which to next try to split it into frames
+    size_t nextSplit;
+
+    /// Have we checked that the stream can be split into frames?
+    bool checkedFormat = false;
+
+    /// Have we been given any data?
+    bool started = false;
+};
+
+} // namespace MLDB
@@ -0,0 +1,267 @@
+/** ranged_streambuf.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Seekable stream buffer over a remote object that is read in blocks
+    with ranged requests.
+*/
+
+#include "ranged_streambuf.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
+#include <cstring>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* RANGED READ STREAMBUF                                                     */
+/*****************************************************************************/
+
+bool
+parseRangedReadOptions(const std::map<std::string, std::string> & options,
+                       RangedReadOptions & result)
+{
+    auto it = options.find("random-access");
+    if (it == options.end() || it->second != "true")
+        return false;
+
+    for (auto & opt: options) {
+        if (opt.first == "block-size")
+            result.blockSize = std::stoull(opt.second);
+        else if (opt.first == "cache-blocks")
+            result.cacheBlocks = std::stoull(opt.second);
+        else if (opt.first == "read-ahead-blocks")
+            result.maxReadAheadBlocks = std::stoull(opt.second);
+    }
+
+    return true;
+}
+
+RangedReadStreambuf::
+RangedReadStreambuf(uint64_t size,
+                    RangeFetcher fetch,
+                    const RangedReadOptions & options)
+    : size_(size), fetch(std::move(fetch)), options(options),
+      currentStart(0), lastFetchedBlock(-2), readAhead(1),
+      numRequests_(0), bytesFetched_(0)
+{
+    if (this->options.blockSize == 0)
+        throw MLDB::Exception("ranged read block size must be positive");
+    if (this->options.cacheBlocks == 0)
+        this->options.cacheBlocks = 1;
+    if (this->options.maxReadAheadBlocks == 0)
+        this->options.maxReadAheadBlocks = 1;
+    numBlocks = (size_ + this->options.blockSize - 1) / this->options.blockSize;
+    setg(nullptr, nullptr, nullptr);
+}
+
+RangedReadStreambuf::
+~RangedReadStreambuf()
+{
+}
+
+uint64_t
+RangedReadStreambuf::
+position() const
+{
+    if (!current)
+        return currentStart;
+    return currentStart + (gptr() - eback());
+}
+
+void
+RangedReadStreambuf::
+insertBlock(uint64_t blockNum, Block block)
+{
+    lru.push_front(blockNum);
+    cache[blockNum] = { std::move(block), lru.begin() };
+
+    while (cache.size() > options.cacheBlocks) {
+        cache.erase(lru.back());
+        lru.pop_back();
+    }
+}
+
+RangedReadStreambuf::Block
+RangedReadStreambuf::
+getBlock(uint64_t blockNum, uint64_t lastBlock)
+{
+    ExcAssertLess(blockNum, numBlocks);
+
+    auto it = cache.find(blockNum);
+    if (it != cache.end()) {
+        lru.splice(lru.begin(), lru, it->second.second);
+        return it->second.first;
+    }
+
+    // Sequential misses fetch more and more blocks at once; anything else
+    // starts again with a single block.
+    if ((int64_t)blockNum == lastFetchedBlock + 1)
+        readAhead = std::min(readAhead * 2, options.maxReadAheadBlocks);
+    else readAhead = 1;
+
+    uint64_t endBlock = std::max(lastBlock, blockNum + readAhead - 1);
+    endBlock = std::min(endBlock, numBlocks - 1);
+
+    // Don't fetch more than the cache can hold, or the first blocks would
+    // be evicted before they are read
+    endBlock = std::min<uint64_t>(endBlock, blockNum + options.cacheBlocks - 1);
+
+    // Stop at the first block that we already have
+    for (uint64_t b = blockNum + 1;  b <= endBlock;  ++b) {
+        if (cache.count(b)) {
+            endBlock = b - 1;
+            break;
+        }
+    }
+
+    uint64_t start = blockNum * options.blockSize;
+    uint64_t end = std::min<uint64_t>((endBlock + 1) * options.blockSize, size_);
+    std::string data = fetch(start, end - start);
+    if (data.size() != end - start) {
+        throw MLDB::Exception("ranged read of bytes %lld-%lld returned %lld "
+                              "bytes", (long long)start, (long long)end,
+                              (long long)data.size());
+    }
+
+    ++numRequests_;
+    bytesFetched_ += data.size();
+    lastFetchedBlock = endBlock;
+
+    Block result;
+    for (uint64_t b = blockNum;  b <= endBlock;  ++b) {
+        uint64_t offset = (b - blockNum) * options.blockSize;
+        size_t length = std::min<uint64_t>(options.blockSize,
+                                           data.size() - offset);
+        Block block;
+        if (blockNum == endBlock) {
+            block = std::make_shared<std::string>(std::move(data));
+        }
+        else {
+            block = std::make_shared<std::string>(data, offset, length);
+        }
+        if (b == blockNum)
+            result = block;
+        insertBlock(b, std::move(block));
+    }
+
+    return result;
+}
+
+bool
+RangedReadStreambuf::
+loadBlockAt(uint64_t pos)
+{
+    if (pos >= size_)
+        return false;
+
+    uint64_t blockNum = pos / options.blockSize;
+    current = getBlock(blockNum, blockNum);
+    currentStart = blockNum * options.blockSize;
+    char * base = const_cast<char *>(current->data());
+    setg(base, base + (pos - currentStart), base + current->size());
+    return true;
+}
+
+RangedReadStreambuf::int_type
+RangedReadStreambuf::
+underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    if (!loadBlockAt(position()))
+        return traits_type::eof();
+
+    return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize
+RangedReadStreambuf::
+xsgetn(char_type * s, std::streamsize n)
+{
+    std::streamsize done = 0;
+
+    while (done < n) {
+        if (gptr() == egptr()) {
+            uint64_t pos = position();
+            if (pos >= size_)
+                break;
+
+            // Fetch everything that's missing for the rest of the read
+            // with as few requests as possible
+            uint64_t lastByte = std::min<uint64_t>(pos + (n - done), size_) - 1;
+            uint64_t blockNum = pos / options.blockSize;
+            current = getBlock(blockNum, lastByte / options.blockSize);
+            currentStart = blockNum * options.blockSize;
+            char * base = const_cast<char *>(current->data());
+            setg(base, base + (pos - currentStart), base + current->size());
+        }
+
+        std::streamsize toDo = std::min<std::streamsize>(egptr() - gptr(),
+                                                         n - done);
+        std::memcpy(s + done, gptr(), toDo);
+        gbump(toDo);
+        done += toDo;
+    }
+
+    return done;
+}
+
+std::streamsize
+RangedReadStreambuf::
+showmanyc()
+{
+    uint64_t pos = position();
+    if (pos >= size_)
+        return -1;
+    return size_ - pos;
+}
+
+RangedReadStreambuf::pos_type
+RangedReadStreambuf::
+seekoff(off_type off, std::ios_base::seekdir dir,
+        std::ios_base::openmode which)
+{
+    if (!(which & std::ios_base::in))
+        return pos_type(off_type(-1));
+
+    int64_t target;
+    switch (dir) {
+    case std::ios_base::beg: target = off;  break;
+    case std::ios_base::cur: target = position() + off;  break;
+    case std::ios_base::end: target = size_ + off;  break;
+    default:
+        return pos_type(off_type(-1));
+    }
+
+    if (target < 0 || (uint64_t)target > size_)
+        return pos_type(off_type(-1));
+
+    if (current && (uint64_t)target >= currentStart
+        && (uint64_t)target <= currentStart + current->size()) {
+        setg(eback(), eback() + (target - currentStart), egptr());
+    }
+    else {
+        // The block will be loaded by the next read
+        current.reset();
+        currentStart = target;
+        setg(nullptr, nullptr, nullptr);
+    }
+
+    return pos_type(target);
+}
+
+RangedReadStreambuf::pos_type
+RangedReadStreambuf::
+seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+} // namespace MLDB
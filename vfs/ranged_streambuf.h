@@ -0,0 +1,121 @@
+/** ranged_streambuf.h                                             -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Seekable stream buffer over a remote object that is read in blocks
+    with ranged requests.
+*/
+
+#pragma once
+
+#include <streambuf>
+#include <functional>
+#include <memory>
+#include <string>
+#include <list>
+#include <map>
+#include <cstdint>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* RANGED READ STREAMBUF                                                     */
+/*****************************************************************************/
+
+/** Function that returns the given byte range of an object.  It must
+    return exactly length bytes, or throw.
+*/
+typedef std::function<std::string (uint64_t offset, uint64_t length)>
+RangeFetcher;
+
+/** Tuning of a ranged read, set from the "block-size", "cache-blocks" and
+    "read-ahead-blocks" options of filter_istream.
+*/
+struct RangedReadOptions {
+    size_t blockSize = 1024 * 1024; ///< Granularity of requests and caching
+    size_t cacheBlocks = 64;        ///< Blocks kept in memory
+    size_t maxReadAheadBlocks = 16; ///< Largest request of a sequential read
+};
+
+/** Return whether the filter_istream options ask for random access (the
+    "random-access" option set to "true"), in which case the tuning
+    options above are read into result.
+*/
+bool parseRangedReadOptions(const std::map<std::string, std::string> & options,
+                            RangedReadOptions & result);
+
+/** Random access, read only stream buffer over an object of known size
+    (an S3 object or an HTTP resource that accepts Range requests).
+
+    The object is read in aligned blocks that are kept in a least recently
+    used cache, so that reading around a small region (a zip central
+    directory, a file footer, ...) only fetches the blocks that are
+    touched.  Blocks that are missing and contiguous are fetched with a
+    single request, and while reading sequentially the number of blocks
+    fetched ahead of the reader doubles with each request, so that a
+    sequential scan isn't dominated by request latency.
+
+    Like any streambuf, it's not thread safe.
+*/
+struct RangedReadStreambuf: public std::streambuf {
+    RangedReadStreambuf(uint64_t size,
+                        RangeFetcher fetch,
+                        const RangedReadOptions & options = RangedReadOptions());
+
+    ~RangedReadStreambuf();
+
+    /** Size of the object. */
+    uint64_t size() const { return size_; }
+
+    /** Number of requests made so far, and the number of bytes they
+        returned. */
+    size_t numRequests() const { return numRequests_; }
+    uint64_t bytesFetched() const { return bytesFetched_; }
+
+protected:
+    virtual int_type underflow() override;
+    virtual std::streamsize xsgetn(char_type * s, std::streamsize n) override;
+    virtual std::streamsize showmanyc() override;
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which) override;
+    virtual pos_type seekpos(pos_type pos,
+                             std::ios_base::openmode which) override;
+
+private:
+    typedef std::shared_ptr<const std::string> Block;
+
+    /** Current position in the object. */
+    uint64_t position() const;
+
+    /** Make the block containing the position the get area. */
+    bool loadBlockAt(uint64_t pos);
+
+    /** Return the given block, fetching it and those after it that are
+        also needed (up to lastBlock) with a single request when it's not
+        in the cache.
+    */
+    Block getBlock(uint64_t blockNum, uint64_t lastBlock);
+
+    void insertBlock(uint64_t blockNum, Block block);
+
+    uint64_t size_;
+    RangeFetcher fetch;
+    RangedReadOptions options;
+
+    uint64_t numBlocks;
+    Block current;               ///< Block that is the get area
+    uint64_t currentStart;       ///< Offset of the get area in the object
+
+    /// Cached blocks, with their position in the LRU list (front is newest)
+    std::map<uint64_t, std::pair<Block, std::list<uint64_t>::iterator> > cache;
+    std::list<uint64_t> lru;
+
+    int64_t lastFetchedBlock;    ///< Last block of the previous request
+    size_t readAhead;            ///< Blocks to fetch on a sequential miss
+
+    size_t numRequests_;
+    uint64_t bytesFetched_;
+};
+
+} // namespace MLDB
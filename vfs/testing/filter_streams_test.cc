@@ -14,6 +14,8 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/filter_streams_registry.h"
+#include "mldb/vfs/compressor.h"
+#include "mldb/vfs/uri_cache.h"
 #include "mldb/arch/exception.h"
 #include "mldb/arch/exception_handler.h"
 
@@ -390,6 +392,145 @@ BOOST_AUTO_TEST_CASE( test_mem_scheme_in )
     BOOST_CHECK_EQUAL(text, result);
 }
 
+/* ensures that streams made of several independently compressed frames
+   (bgzip, pbzip2, pzstd or concatenated files) are read in full, which is
+   what allows them to be decompressed in parallel */
+BOOST_AUTO_TEST_CASE( test_multi_frame_streams )
+{
+    Scope_Exit(deleteAllMemStreamStrings());
+
+    string text;
+    for (int i = 0; i < 1000000; i++) {
+        text += std::to_string(i * 7919LL % 1000003) + "\n";
+    }
+
+    for (string ext: { "gz", "bz2", "zst" }) {
+        cerr << "testing extension " << ext << endl;
+        string compression = Compressor::filenameToCompression("x." + ext);
+
+        string compressed;
+        auto onData = [&] (const char * data, size_t len)
+            {
+                compressed.append(data, len);
+                return len;
+            };
+
+        size_t frameSize = 100000;
+        for (size_t i = 0;  i < text.size();  i += frameSize) {
+            std::unique_ptr<Compressor> compressor
+                (Compressor::create(compression, 1));
+            compressor->compress(text.data() + i,
+                                 std::min(frameSize, text.size() - i),
+                                 onData);
+            compressor->finish(onData);
+        }
+
+        setMemStreamString("multi." + ext, compressed);
+
+        string result;
+        filter_istream inS("mem://multi." + ext);
+        while (inS) {
+            char buf[16384];
+            inS.read(buf, 16384);
+            result.append(buf, inS.gcount());
+        }
+
+        BOOST_CHECK_EQUAL(text.size(), result.size());
+        BOOST_CHECK(text == result);
+    }
+}
+
+/* ensures that streams compressed in parallel blocks are read back in
+   full, by the serial and the parallel decompressors */
+BOOST_AUTO_TEST_CASE( test_parallel_compression )
+{
+    Scope_Exit(deleteAllMemStreamStrings());
+
+    string text;
+    for (int i = 0; i < 2000000; i++) {
+        text += std::to_string(i * 7919LL % 1000003) + "\n";
+    }
+
+    for (string ext: { "gz", "bz2", "zst", "lz4" }) {
+        cerr << "testing extension " << ext << endl;
+        for (size_t len: { (size_t)0, (size_t)10, text.size() }) {
+            string filename = "mem://parallel." + ext;
+            {
+                filter_ostream outS(filename,
+                                    { { "compressionThreads", "4" } });
+                outS << text.substr(0, len);
+                outS.close();
+            }
+
+            string result;
+            filter_istream inS(filename);
+            while (inS) {
+                char buf[16384];
+                inS.read(buf, 16384);
+                result.append(buf, inS.gcount());
+            }
+
+            BOOST_CHECK_EQUAL(len, result.size());
+            BOOST_CHECK(text.substr(0, len) == result);
+        }
+    }
+}
+
+/* ensures that the URI cache serves objects from local files, keyed by
+   their version, and evicts the least recently used ones */
+BOOST_AUTO_TEST_CASE( test_uri_cache )
+{
+    Scope_Exit(deleteAllMemStreamStrings());
+
+    string cacheDir = "build/x86_64/tmp/uri_cache_test";
+    fs::remove_all(cacheDir);
+    Scope_Exit(fs::remove_all(cacheDir));
+
+    UriCache cache(cacheDir, 100);
+
+    auto readFile = [] (const string & path)
+        {
+            filter_istream stream(path, { { "mapped", "true" } });
+            return string(std::istreambuf_iterator<char>(stream),
+                          std::istreambuf_iterator<char>());
+        };
+
+    string first(60, 'a');
+    setMemStreamString("first.txt", first);
+    FsObjectInfo info;
+    info.exists = true;
+    info.etag = "1";
+    info.size = first.size();
+
+    string path = cache.getFile("mem://first.txt", info);
+    BOOST_REQUIRE(!path.empty());
+    BOOST_CHECK_EQUAL(readFile(path), first);
+
+    // The same version is served from the cache, without reading it again
+    setMemStreamString("first.txt", string(60, 'b'));
+    BOOST_CHECK_EQUAL(cache.getFile("mem://first.txt", info), path);
+    BOOST_CHECK_EQUAL(readFile(path), first);
+
+    // A new version is read again
+    info.etag = "2";
+    string path2 = cache.getFile("mem://first.txt", info);
+    BOOST_CHECK_NE(path2, path);
+    BOOST_CHECK_EQUAL(readFile(path2), string(60, 'b'));
+
+    // ... and there is only room for one of them
+    BOOST_CHECK(!fs::exists(path));
+    BOOST_CHECK(fs::exists(path2));
+
+    // Objects with nothing to tell their versions apart, or too big for
+    // the cache, aren't cached
+    info.etag = "";
+    BOOST_CHECK_EQUAL(cache.getFile("mem://first.txt", info), "");
+    setMemStreamString("big.txt", string(200, 'c'));
+    info.etag = "3";
+    info.size = 200;
+    BOOST_CHECK_EQUAL(cache.getFile("mem://big.txt", info), "");
+}
+
 /* Testing the behaviour of filter_stream when exceptions occur during read,
  * write, close or destruction */
 struct ExceptionSource {
@@ -0,0 +1,146 @@
+/* ranged_streambuf_test.cc
+   This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+   Tests for the block cached, seekable stream buffer used for random
+   access to remote objects.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/vfs/ranged_streambuf.h"
+#include <boost/test/unit_test.hpp>
+#include <istream>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+struct TestObject {
+    TestObject(size_t size)
+    {
+        for (size_t i = 0;  i < size;  ++i)
+            data.push_back('a' + (i * 7 + i / 13) % 26);
+    }
+
+    RangeFetcher fetcher()
+    {
+        return [this] (uint64_t offset, uint64_t length)
+            {
+                BOOST_REQUIRE_LE(offset + length, data.size());
+                requests.emplace_back(offset, length);
+                return data.substr(offset, length);
+            };
+    }
+
+    std::string data;
+    std::vector<std::pair<uint64_t, uint64_t> > requests;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_sequential_read )
+{
+    TestObject obj(100000);
+    RangedReadOptions options;
+    options.blockSize = 1000;
+    options.maxReadAheadBlocks = 8;
+    RangedReadStreambuf buf(obj.data.size(), obj.fetcher(), options);
+    std::istream stream(&buf);
+
+    std::string contents((std::istreambuf_iterator<char>(stream)),
+                         std::istreambuf_iterator<char>());
+    BOOST_CHECK(contents == obj.data);
+
+    // Read ahead ramps up, so there are far fewer requests than blocks
+    BOOST_CHECK_LT(obj.requests.size(), 20);
+    BOOST_CHECK_EQUAL(buf.bytesFetched(), obj.data.size());
+}
+
+BOOST_AUTO_TEST_CASE( test_random_access )
+{
+    TestObject obj(1000000);
+    RangedReadOptions options;
+    options.blockSize = 4096;
+    options.cacheBlocks = 8;
+    RangedReadStreambuf buf(obj.data.size(), obj.fetcher(), options);
+    std::istream stream(&buf);
+
+    std::mt19937 rng(1);
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        size_t offset = rng() % obj.data.size();
+        size_t length = std::min<size_t>(rng() % 20000, obj.data.size() - offset);
+        stream.seekg(offset);
+        BOOST_REQUIRE(stream);
+        BOOST_CHECK_EQUAL(stream.tellg(), offset);
+        std::string read(length, '\0');
+        stream.read(&read[0], length);
+        BOOST_REQUIRE_EQUAL(stream.gcount(), length);
+        BOOST_REQUIRE(read == obj.data.substr(offset, length));
+    }
+
+    // Seek from the end, like a reader of a footer would
+    stream.seekg(-10, std::ios_base::end);
+    std::string footer(10, '\0');
+    stream.read(&footer[0], 10);
+    BOOST_CHECK(footer == obj.data.substr(obj.data.size() - 10));
+
+    // Reading past the end gives a short read
+    stream.clear();
+    stream.seekg(-5, std::ios_base::end);
+    char tail[10];
+    stream.read(tail, 10);
+    BOOST_CHECK_EQUAL(stream.gcount(), 5);
+}
+
+BOOST_AUTO_TEST_CASE( test_only_touched_blocks_are_fetched )
+{
+    TestObject obj(160 * 65536);
+    RangedReadOptions options;
+    options.blockSize = 65536;
+    RangedReadStreambuf buf(obj.data.size(), obj.fetcher(), options);
+    std::istream stream(&buf);
+
+    // Footer, then something near the start, then the footer again
+    char c;
+    stream.seekg(-100, std::ios_base::end);
+    stream.get(c);
+    stream.seekg(100);
+    stream.get(c);
+    stream.seekg(-50, std::ios_base::end);
+    stream.get(c);
+
+    BOOST_CHECK_EQUAL(obj.requests.size(), 2);
+    BOOST_CHECK_EQUAL(buf.bytesFetched(), 2 * options.blockSize);
+}
+
+BOOST_AUTO_TEST_CASE( test_large_read_is_coalesced )
+{
+    TestObject obj(1000000);
+    RangedReadOptions options;
+    options.blockSize = 1000;
+    options.maxReadAheadBlocks = 1;
+    RangedReadStreambuf buf(obj.data.size(), obj.fetcher(), options);
+    std::istream stream(&buf);
+
+    // One read over 20 blocks is a single request
+    stream.seekg(500000);
+    std::string read(20000, '\0');
+    stream.read(&read[0], read.size());
+    BOOST_CHECK(read == obj.data.substr(500000, 20000));
+    BOOST_CHECK_EQUAL(obj.requests.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_empty_object )
+{
+    TestObject obj(0);
+    RangedReadStreambuf buf(0, obj.fetcher());
+    std::istream stream(&buf);
+    char c;
+    BOOST_CHECK(!stream.get(c));
+    BOOST_CHECK_EQUAL(obj.requests.size(), 0);
+}
@@ -0,0 +1,207 @@
+/** uri_cache.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Local disk cache of the objects read from remote URIs.
+*/
+
+#include "uri_cache.h"
+#include "filter_streams.h"
+#include "mldb/arch/exception.h"
+#include "mldb/compiler/filesystem.h"
+#include "mldb/ext/xxhash/xxhash.h"
+#include <atomic>
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* URI CACHE                                                                 */
+/*****************************************************************************/
+
+namespace {
+
+std::mutex defaultCacheMutex;
+std::shared_ptr<UriCache> defaultCache;
+bool defaultCacheInitialized = false;
+
+// Marks the files that are still being downloaded
+const std::string TMP_MARKER = ".tmp.";
+
+std::shared_ptr<UriCache> createDefaultCache()
+{
+    const char * dir = getenv("MLDB_URI_CACHE_DIR");
+    if (!dir || !*dir)
+        return nullptr;
+
+    uint64_t maxSize = 10ULL * 1024 * 1024 * 1024;
+    const char * size = getenv("MLDB_URI_CACHE_SIZE");
+    if (size && *size) {
+        try {
+            maxSize = std::stoull(size);
+        } catch (const std::exception & exc) {
+            throw MLDB::Exception("Couldn't parse MLDB_URI_CACHE_SIZE '%s' "
+                                  "as a number of bytes", size);
+        }
+    }
+
+    return std::make_shared<UriCache>(dir, maxSize);
+}
+
+/// Key under which the given version of the object at uri is cached, or
+/// an empty string if nothing tells apart versions of the object.
+std::string getCacheKey(const std::string & uri, const FsObjectInfo & info)
+{
+    if (info.etag.empty() && !info.lastModified.isADate())
+        return std::string();
+
+    std::string version = uri + '\n' + info.etag + '\n'
+        + (info.lastModified.isADate() ? info.lastModified.printIso8601(6) : "")
+        + '\n' + std::to_string(info.size);
+
+    char result[33];
+    snprintf(result, sizeof(result), "%016llx%016llx",
+             (unsigned long long)XXH64(version.data(), version.size(), 0),
+             (unsigned long long)XXH64(version.data(), version.size(), 1));
+    return result;
+}
+
+} // file scope
+
+UriCache::
+UriCache(std::string directory, uint64_t maxSize)
+    : directory_(std::move(directory)),
+      maxSize_(maxSize)
+{
+    fs::create_directories(directory_);
+}
+
+std::string
+UriCache::
+getFile(const std::string & uri, const FsObjectInfo & info)
+{
+    std::string key = getCacheKey(uri, info);
+    if (key.empty() || info.size <= 0 || info.size > maxSize_)
+        return std::string();
+
+    std::string path = directory_ + "/" + key;
+
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        std::error_code ec;
+        if (fs::exists(path, ec)) {
+            // The modification time is when it was last used
+            fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+            return path;
+        }
+    }
+
+    // Download under a name of our own, so that concurrent downloads of
+    // the same object (here or in another process) don't get mixed up
+    static std::atomic<uint64_t> numDownloads(0);
+    std::string tmpPath = path + TMP_MARKER + std::to_string(getpid())
+        + "." + std::to_string(numDownloads++);
+
+    try {
+        filter_istream in(uri, { { "compression", "none" },
+                                 { "cache", "false" } });
+        std::ofstream out(tmpPath, std::ios::binary);
+        out << in.rdbuf();
+        out.close();
+        in.close();
+        if (!out)
+            throw MLDB::Exception("Couldn't write " + tmpPath);
+    } catch (...) {
+        std::error_code ec;
+        fs::remove(tmpPath, ec);
+        throw;
+    }
+
+    std::unique_lock<std::mutex> guard(mutex);
+
+    // If the object changed while it was downloading, we can't tell which
+    // version we got, so we don't keep it
+    std::error_code ec;
+    if (fs::file_size(tmpPath, ec) != (uint64_t)info.size) {
+        fs::remove(tmpPath, ec);
+        return std::string();
+    }
+
+    makeRoom(info.size);
+    fs::rename(tmpPath, path);
+    return path;
+}
+
+void
+UriCache::
+makeRoom(uint64_t needed)
+{
+    struct Entry {
+        fs::file_time_type lastUsed;
+        uint64_t size;
+        fs::path path;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t totalSize = 0;
+
+    std::error_code ec;
+    for (auto & file: fs::directory_iterator(directory_, ec)) {
+        if (!file.is_regular_file(ec)
+            || file.path().filename().string().find(TMP_MARKER)
+               != std::string::npos)
+            continue;
+        uint64_t size = file.file_size(ec);
+        if (ec)
+            continue;
+        entries.push_back({ file.last_write_time(ec), size, file.path() });
+        totalSize += size;
+    }
+
+    std::sort(entries.begin(), entries.end(),
+              [] (const Entry & e1, const Entry & e2)
+              {
+                  return e1.lastUsed < e2.lastUsed;
+              });
+
+    for (auto & e: entries) {
+        if (totalSize + needed <= maxSize_)
+            break;
+        // Readers that already have it open or mapped keep their copy
+        if (fs::remove(e.path, ec))
+            totalSize -= e.size;
+    }
+}
+
+std::shared_ptr<UriCache>
+UriCache::
+getDefault()
+{
+    std::unique_lock<std::mutex> guard(defaultCacheMutex);
+    if (!defaultCacheInitialized) {
+        defaultCache = createDefaultCache();
+        defaultCacheInitialized = true;
+    }
+    return defaultCache;
+}
+
+void
+UriCache::
+setDefault(std::shared_ptr<UriCache> cache)
+{
+    std::unique_lock<std::mutex> guard(defaultCacheMutex);
+    defaultCache = std::move(cache);
+    defaultCacheInitialized = true;
+}
+
+} // namespace MLDB
@@ -0,0 +1,76 @@
+/** uri_cache.h                                                    -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Local disk cache of the objects read from remote URIs.
+*/
+
+#pragma once
+
+#include "fs_utils.h"
+#include <memory>
+#include <mutex>
+#include <string>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* URI CACHE                                                                 */
+/*****************************************************************************/
+
+/** Cache on local disk of the objects read from remote URIs (s3://,
+    http://, ...), so that reading the same object again doesn't download
+    it again.
+
+    Each object is stored in a file named by a hash of its URI and of the
+    ETag, modification date and size from its FsObjectInfo, so that an
+    object that has changed is never served from the cache.  The total size
+    of the files is kept under a maximum by removing the least recently
+    used ones.  Files are written under a temporary name and renamed into
+    place, so several processes can share the same directory.
+
+    filter_istream reads remote objects through the default cache, which
+    is set up from the MLDB_URI_CACHE_DIR (caching is off if it's not set)
+    and MLDB_URI_CACHE_SIZE (in bytes; 10GB by default) environment
+    variables.  As the cached copy is a local file, "mapped" opens of it
+    are mapped directly.  Reads with the "cache" option set to "false"
+    bypass the cache.
+*/
+
+struct UriCache {
+    UriCache(std::string directory, uint64_t maxSize);
+
+    /** Return the path to the local copy of the object at the given uri,
+        which has the given info, downloading it if it's not in the cache
+        already.  Returns an empty string if the object can't be cached,
+        because there is nothing in the info to tell when it has changed
+        or it's too big for the cache.
+    */
+    std::string getFile(const std::string & uri, const FsObjectInfo & info);
+
+    /// Directory the cached objects are stored in
+    const std::string & directory() const { return directory_; }
+
+    /// Maximum total size of the cached objects, in bytes
+    uint64_t maxSize() const { return maxSize_; }
+
+    /** Return the default cache used by filter_istream, or null if caching
+        is turned off.
+    */
+    static std::shared_ptr<UriCache> getDefault();
+
+    /** Replace the default cache.  Passing null turns caching off. */
+    static void setDefault(std::shared_ptr<UriCache> cache);
+
+private:
+    /// Remove the least recently used files until there is room for
+    /// needed more bytes.  The mutex must be held.
+    void makeRoom(uint64_t needed);
+
+    std::string directory_;
+    uint64_t maxSize_;
+    std::mutex mutex;
+};
+
+} // namespace MLDB
@@ -4,7 +4,11 @@ LIBVFS_SOURCES := \
 	fs_utils.cc \
         filter_streams.cc \
 	http_streambuf.cc \
+	ranged_streambuf.cc \
 	compressor.cc \
+	parallel_compressor.cc \
+	parallel_decompressor.cc \
+	uri_cache.cc \
 	exception_ptr.cc \
 	libdb_initialization.cc \
 	\
@@ -17,6 +21,7 @@ LIBVFS_SOURCES := \
 
 LIBVFS_LINK := \
 	arch \
+	base \
 	boost_iostreams \
 	types \
 	$(STD_FILESYSTEM_LIBNAME) \
@@ -138,12 +138,76 @@ struct ZStandardDecompressor: public Decompressor {
         
     }
     
+    virtual int64_t frameLength(const char * block, size_t blockLen,
+                                bool & speculative) const override
+    {
+        const unsigned char * p = (const unsigned char *)block;
+
+        auto read32 = [&] (size_t pos) -> uint32_t
+            {
+                return p[pos] | (p[pos + 1] << 8) | (p[pos + 2] << 16)
+                    | ((uint32_t)p[pos + 3] << 24);
+            };
+
+        if (blockLen < 8)
+            return LENGTH_INSUFFICIENT_DATA;
+
+        speculative = false;
+        uint32_t magic = read32(0);
+
+        // Skippable frames (written by pzstd, amongst others) say how
+        // long they are
+        if ((magic & 0xfffffff0) == 0x184d2a50)
+            return 8 + (int64_t)read32(4);
+
+        // Frames of the legacy formats can't be walked
+        if (magic != 0xfd2fb528)
+            return LENGTH_UNKNOWN;
+
+        // Skip the frame header
+        static const int DICT_ID_LENGTHS[4] = { 0, 1, 2, 4 };
+        static const int CONTENT_SIZE_LENGTHS[4] = { 0, 2, 4, 8 };
+        unsigned descriptor = p[4];
+        bool singleSegment = descriptor & 0x20;
+        bool hasChecksum = descriptor & 0x04;
+        size_t pos = 5 + !singleSegment
+            + DICT_ID_LENGTHS[descriptor & 3]
+            + CONTENT_SIZE_LENGTHS[descriptor >> 6];
+        if (singleSegment && (descriptor >> 6) == 0)
+            pos += 1;
+
+        // Walk the blocks to find the end of the frame
+        for (bool lastBlock = false;  !lastBlock;) {
+            if (pos + 3 > blockLen)
+                return LENGTH_INSUFFICIENT_DATA;
+            uint32_t header = p[pos] | (p[pos + 1] << 8) | (p[pos + 2] << 16);
+            lastBlock = header & 1;
+            int blockType = (header >> 1) & 3;
+            if (blockType == 3)
+                return LENGTH_UNKNOWN;  // reserved; it won't decompress
+            // RLE blocks have a single byte, which is repeated
+            pos += 3 + (blockType == 1 ? 1 : header >> 3);
+        }
+
+        if (hasChecksum)
+            pos += 4;
+        if (pos > blockLen)
+            return LENGTH_INSUFFICIENT_DATA;
+        return pos;
+    }
+    
     virtual void decompress(const char * data, size_t len,
                             const OnData & onData) override
     {
         ZSTD_inBuffer inBuf{data, len, 0};
 
         while (inBuf.pos < inBuf.size) {
+            if (frameEnded) {
+                // Another frame follows the one that finished
+                ZSTD_initDStream(stream);
+                frameEnded = false;
+            }
+            started = true;
             outBuf.pos = 0;
             size_t res = ZSTD_decompressStream(stream, &outBuf, &inBuf);
             if (ZSTD_isError(res)) {
@@ -151,14 +215,26 @@ struct ZStandardDecompressor: public Decompressor {
                                 ZSTD_getErrorName(res));
             }
             writeAll(onData);
-            if (res == 0 && inBuf.pos < inBuf.size) {
-                throw Exception("Extra bytes at end of decompressed zstandard stream");
-            }
+            frameEnded = res == 0;
         }
     }
     
     virtual void finish(const OnData & onData) override
     {
+        // Get out anything the stream is still holding on to
+        ZSTD_inBuffer inBuf{nullptr, 0, 0};
+        while (started && !frameEnded) {
+            outBuf.pos = 0;
+            size_t res = ZSTD_decompressStream(stream, &outBuf, &inBuf);
+            if (ZSTD_isError(res)) {
+                throw Exception("Error compression zstandard stream: %s",
+                                ZSTD_getErrorName(res));
+            }
+            writeAll(onData);
+            frameEnded = res == 0;
+            if (!frameEnded && outBuf.pos == 0)
+                throw Exception("zstandard stream is truncated");
+        }
     }
 
     size_t writeAll(const OnData & onData)
@@ -175,6 +251,8 @@ struct ZStandardDecompressor: public Decompressor {
     size_t outDataSize = 0;
     std::unique_ptr<char[]> outData;
     ZSTD_outBuffer outBuf;
+    bool started = false;     ///< Have we been given any data?
+    bool frameEnded = false;  ///< Did the last frame finish?
 };
 
 static Decompressor::Register<ZStandardDecompressor>
@@ -10,7 +10,12 @@
 
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/base/scope.h"
+#include "mldb/compiler/compiler.h"
 #include "mldb/vfs/filter_streams_registry.h"
+#include "mldb/vfs/compressor.h"
+#include "mldb/vfs_handlers/zip_index.h"
+#include <algorithm>
+#include <mutex>
 #include "mldb/arch/exception.h"
 #include <sstream>
 
@@ -53,18 +58,154 @@ static int myclose(struct archive *a, void *client_data)
     return ARCHIVE_OK;
 }
 
+static __LA_INT64_T myseek(struct archive *a, void *client_data,
+                           __LA_INT64_T offset, int whence)
+{
+    ArchiveData * data = reinterpret_cast<ArchiveData *>(client_data);
+    std::ios_base::seekdir dir
+        = whence == SEEK_SET ? std::ios_base::beg
+        : whence == SEEK_CUR ? std::ios_base::cur
+        : std::ios_base::end;
+    data->stream.clear();
+    std::streampos pos = data->stream.rdbuf()->pubseekoff(offset, dir,
+                                                          std::ios_base::in);
+    if (pos == std::streampos(-1))
+        return ARCHIVE_FATAL;
+    return pos;
+}
+
+static __LA_INT64_T myskip(struct archive *a, void *client_data,
+                           __LA_INT64_T request)
+{
+    ArchiveData * data = reinterpret_cast<ArchiveData *>(client_data);
+    data->stream.clear();
+    std::streambuf * buf = data->stream.rdbuf();
+    std::streampos start = buf->pubseekoff(0, std::ios_base::cur,
+                                           std::ios_base::in);
+    std::streampos end = buf->pubseekoff(0, std::ios_base::end,
+                                         std::ios_base::in);
+    if (start == std::streampos(-1) || end == std::streampos(-1))
+        return 0;  // libarchive will read through instead
+    __LA_INT64_T toSkip = std::min<__LA_INT64_T>(request, end - start);
+    buf->pubseekoff(start + std::streamoff(toSkip), std::ios_base::beg,
+                    std::ios_base::in);
+    return toSkip;
+}
+
+/** Open the given stream as an archive, returning a libarchive handle that
+    must be released with archive_read_finish.
+
+    If the stream is random seekable (a local file, or a remote one opened
+    with the "random-access" option), libarchive is allowed to seek and
+    skip in it, so that only the parts of the archive that are used are
+    read; for a zip file, that's the central directory and the members
+    that are extracted.
+*/
+static struct archive * openArchive(std::streambuf * streambuf,
+                                    bool seekable = false)
+{
+    struct archive * a = archive_read_new();
+    archive_read_support_compression_all(a);
+    archive_read_support_format_all(a);
+    if (!seekable) {
+        archive_read_open(a, new ArchiveData(streambuf), NULL, myread, myclose);
+        return a;
+    }
+    archive_read_set_read_callback(a, myread);
+    archive_read_set_seek_callback(a, myseek);
+    archive_read_set_skip_callback(a, myskip);
+    archive_read_set_close_callback(a, myclose);
+    archive_read_set_callback_data(a, new ArchiveData(streambuf));
+    archive_read_open1(a);
+    return a;
+}
+
+/** Stream over an archive, and whether it can be seeked in. */
+struct ArchiveSource {
+    std::shared_ptr<filter_istream> stream;
+    bool seekable;
+};
+
+/** Open the archive at the given URI, with random access when it's not
+    compressed as a whole (a compressed stream can't be seeked in).
+*/
+static ArchiveSource
+openArchiveSource(const std::string & uri)
+{
+    bool compressed = !Compressor::filenameToCompression(uri).empty();
+    bool local = uri.find("://") == std::string::npos
+        || uri.compare(0, 7, "file://") == 0;
+
+    std::map<std::string, std::string> options;
+    if (!compressed && !local) {
+        options["random-access"] = "true";
+    }
+
+    ArchiveSource result;
+    result.stream = std::make_shared<filter_istream>(uri, options);
+    result.seekable = !compressed
+        && (local || result.stream->isRandomSeekable());
+    return result;
+}
+
+
+/*****************************************************************************/
+/* ZIP INDEX CACHE                                                           */
+/*****************************************************************************/
+
+/** Return the index of the zip archive at the given URI, or null if it's
+    not a zip file.  Indexes are cached, so that the central directory is
+    only read once for all of the members that are opened; the entry is
+    invalidated if the archive changes.
+*/
+static std::shared_ptr<const ZipIndex>
+getZipIndex(const std::string & uri, filter_istream & stream)
+{
+    FsObjectInfo info = stream.info();
+    if (info.size < 0)
+        return nullptr;
+
+    std::string version = info.etag + "/" + std::to_string(info.size)
+        + "/" + info.lastModified.print(6);
+
+    static std::mutex cacheLock;
+    static std::map<std::string,
+                    std::pair<std::string,
+                              std::shared_ptr<const ZipIndex> > > cache;
+
+    {
+        std::unique_lock<std::mutex> guard(cacheLock);
+        auto it = cache.find(uri);
+        if (it != cache.end() && it->second.first == version)
+            return it->second.second;
+    }
+
+    std::shared_ptr<const ZipIndex> result;
+    try {
+        result = ZipIndex::read(stream, info.size);
+    } MLDB_CATCH_ALL {
+        // Leave it to libarchive to make sense of it
+    }
+    stream.clear();
+    stream.seekg(0);
+
+    std::unique_lock<std::mutex> guard(cacheLock);
+    if (cache.size() >= 256)
+        cache.clear();
+    cache[uri] = { version, result };
+    return result;
+}
+
 static bool list_archive(std::streambuf * streambuf,
+                         bool seekable,
                          std::function<bool (const std::string & filename,
                                              struct archive * a,
                                              struct archive_entry * entry)> cb)
 {
     struct archive_entry *entry;
-    struct archive * a = archive_read_new();
+    struct archive * a = openArchive(streambuf, seekable);
     Scope_Exit(archive_read_finish(a));
 
-    archive_read_support_compression_all(a);
-    archive_read_support_format_all(a);
-    archive_read_open(a, new ArchiveData(streambuf), NULL, myread, myclose);
     while (archive_read_next_header(a, &entry) == ARCHIVE_OK) {
         string filename = archive_entry_pathname(entry);
 
@@ -75,9 +216,77 @@ static bool list_archive(std::streambuf * streambuf,
     return true;
 }
 
+static std::shared_ptr<FsObjectInfo>
+getEntryInfo(struct archive_entry * entry)
+{
+    auto info = std::make_shared<FsObjectInfo>();
+    info->size
+        = archive_entry_size_is_set(entry) ?
+        archive_entry_size(entry) : -1;
+    info->exists = true;
+    if (archive_entry_mtime_is_set(entry)) {
+        info->lastModified = Date::fromSecondsSinceEpoch(archive_entry_mtime(entry) + 0.000000001 * archive_entry_mtime_nsec(entry));
+    }
+    else info->lastModified = Date::notADate();
+
+    info->ownerId = std::to_string(archive_entry_uid(entry));
+    const char * gname = archive_entry_gname(entry);
+    if (gname)
+        info->ownerName = gname;
+    //info.permissions = archive_entry_strmode(entry);
+    return info;
+}
+
+
+/*****************************************************************************/
+/* ARCHIVE ENTRY STREAMBUF                                                   */
+/*****************************************************************************/
+
+/** Stream buffer over the data of the archive entry that is currently being
+    read, which is decompressed one block at a time as it is consumed
+    instead of being extracted into memory first.  The owner, if any, is
+    kept alive for as long as the buffer.
+*/
+struct ArchiveEntryStreambuf: public std::streambuf {
+    ArchiveEntryStreambuf(struct archive * a,
+                          std::shared_ptr<void> owner = nullptr)
+        : a(a), owner(std::move(owner))
+    {
+    }
+
+    virtual int_type underflow() override
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+
+        const void * buff;
+        size_t size = 0;
+        // This is a type exported by libarchive
+        __LA_INT64_T offset = 0;
+
+        for (;;) {
+            int r = archive_read_data_block(a, &buff, &size, &offset);
+            if (r == ARCHIVE_EOF)
+                return traits_type::eof();
+            if (r < ARCHIVE_OK)
+                throw MLDB::Exception("Error extracting file");
+            if (size == 0)
+                continue;
+
+            char * data = (char *)buff;
+            setg(data, data, data + size);
+            return traits_type::to_int_type(*data);
+        }
+    }
+
+    struct archive * a;
+    std::shared_ptr<void> owner;
+};
+
 
 bool iterateArchive(std::streambuf * archive,
-                    const OnUriObject & onObject)
+                    const OnUriObject & onObject,
+                    bool seekable)
 {
     auto onArchiveEntry = [&] (const std::string & filename,
                                struct archive * a,
@@ -87,26 +296,14 @@ bool iterateArchive(std::streambuf * archive,
 
             switch (filetype) {
             case AE_IFREG: {
-                auto info = std::make_shared<FsObjectInfo>();
-                info->size
-                    = archive_entry_size_is_set(entry) ?
-                    archive_entry_size(entry) : -1;
-                info->exists = true;
-                if (archive_entry_mtime_is_set(entry)) {
-                    info->lastModified = Date::fromSecondsSinceEpoch(archive_entry_mtime(entry) + 0.000000001 * archive_entry_mtime_nsec(entry));
-                }
-                else info->lastModified = Date::notADate();
-
-                info->ownerId = std::to_string(archive_entry_uid(entry));
-                const char * gname = archive_entry_gname(entry);
-                if (gname)
-                    info->ownerName = gname;
-                //info.permissions = archive_entry_strmode(entry);
+                auto info = getEntryInfo(entry);
 
                 auto open = [=] (const std::map<std::string, std::string> & options)
                     {
-                        // For the moment, copy into a buffer and return
-                        // a stringstream.  Streaming support later.
+                        // The archive moves on to the next entry once we
+                        // return, so the contents are copied into a buffer
+                        // that can outlive the iteration.  Opening the
+                        // member's own URI streams it instead.
                             
                         std::ostringstream stream;
                             
@@ -142,7 +339,7 @@ bool iterateArchive(std::streambuf * archive,
             }
         };
 
-    return list_archive(archive, onArchiveEntry);
+    return list_archive(archive, seekable, onArchiveEntry);
 }
 
 
@@ -229,7 +426,41 @@ struct ArchiveUrlFsHandler: UrlFsHandler {
         if (!archiveSource.removePrefix("archive+"))
             throw MLDB::Exception("archive URI '" + archiveSource.rawString() + "' doesn't start with 'archive+' when listing archive contents");
 
-        filter_istream archiveStream(archiveSource.rawString());
+        std::string archiveUri = archiveSource.rawString();
+        auto source = openArchiveSource(archiveUri);
+
+        // Zip members are listed from the central directory, and each one
+        // is opened on its own stream, so that they can be read at the
+        // same time
+        std::shared_ptr<const ZipIndex> index;
+        if (source.seekable)
+            index = getZipIndex(archiveUri, *source.stream);
+        if (index && std::all_of(index->entries.begin(), index->entries.end(),
+                                 [] (const ZipIndex::Entry & entry)
+                                 {
+                                     return entry.isSupported()
+                                         || entry.isDirectory();
+                                 })) {
+            for (auto & entry: index->entries) {
+                if (entry.isDirectory())
+                    continue;
+                FsObjectInfo info = entry.getInfo();
+                const ZipIndex::Entry * e = &entry;
+                auto open = [archiveUri, index, e, info]
+                    (const std::map<std::string, std::string> & options)
+                    {
+                        auto memberSource = openArchiveSource(archiveUri);
+                        std::shared_ptr<std::streambuf> buf
+                            (openZipMember(*e, *memberSource.stream,
+                                           memberSource.stream));
+                        return UriHandler(buf.get(), buf, info);
+                    };
+                if (!onObject(prefix.toString() + "#" + entry.name, info,
+                              open, 1 /* depth */))
+                    return false;
+            }
+            return true;
+        }
 
         auto onObject2 = [&] (const std::string & object,
                               const FsObjectInfo & info,
@@ -240,7 +471,8 @@ struct ArchiveUrlFsHandler: UrlFsHandler {
             };
 
 
-        return iterateArchive(archiveStream.rdbuf(), onObject2);
+        return iterateArchive(source.stream->rdbuf(), onObject2,
+                              source.seekable);
     }
 };
 
@@ -284,36 +516,53 @@ struct RegisterArchiveHandler {
 
         //cerr << "archiveUri = " << archiveUri << endl;
 
-        // unused...
         Utf8String toExtractPath(std::next(foundIt), archiveSource.end());
 
         //cerr << "uri = " << uri << " archiveSource = " << archiveSource
         //     << " archiveUri = " << archiveUri << " toExtractPath = "
         //     << toExtractPath << endl;
 
-        UriHandler result;
+        // The archive is read up to the member, which is then streamed
+        // from it.  The returned buffer keeps the archive and the stream
+        // it reads from open.
+        auto opened = openArchiveSource(archiveUri.rawString());
+        auto source = opened.stream;
+
+        // A zip member is opened directly at its offset
+        if (opened.seekable) {
+            auto index = getZipIndex(archiveUri.rawString(), *source);
+            const ZipIndex::Entry * entry
+                = index ? index->find(toExtractPath.rawString()) : nullptr;
+            if (index && (!entry || entry->isDirectory()))
+                throw MLDB::Exception("Couldn't find resource "
+                                      + toExtractPath.rawString()
+                                      + " in archive " + archiveUri.rawString());
+            if (entry && entry->isSupported()) {
+                auto info = std::make_shared<FsObjectInfo>(entry->getInfo());
+                std::shared_ptr<std::streambuf> buf
+                    (openZipMember(*entry, *source, source));
+                return UriHandler(buf.get(), buf, info);
+            }
+        }
 
-        OnUriObject onObject = [&] (const std::string & archiveMemberUri,
-                                    const FsObjectInfo & info,
-                                    const OpenUriObject & open,
-                                    int depth)
-            {
-                //cerr << "matching " << archiveMemberUri
-                //<< " against " << uri << endl;
-                if (uri.rawString() == archiveMemberUri) {
-                    result = open(options);
-                    return false;
-                }
-                return true;
-            };
+        std::shared_ptr<struct archive> archive
+            (openArchive(source->rdbuf(), opened.seekable),
+             [source] (struct archive * a) { archive_read_finish(a); });
 
-        forEachUriObject("archive+" + archiveUri.rawString(), onObject, {},
-                         "/" /* delimiter */, "" /* startAt */);
-        if (!result.buf)
-            throw MLDB::Exception("Couldn't find resource " + toExtractPath.rawString()
-                                + " in archive " + archiveUri.rawString());
-        
-        return result;
+        struct archive_entry * entry;
+        while (archive_read_next_header(archive.get(), &entry) == ARCHIVE_OK) {
+            if (archive_entry_filetype(entry) != AE_IFREG
+                || toExtractPath.rawString() != archive_entry_pathname(entry))
+                continue;
+
+            auto info = getEntryInfo(entry);
+            auto buf = std::make_shared<ArchiveEntryStreambuf>
+                (archive.get(), archive);
+            return UriHandler(buf.get(), buf, info);
+        }
+
+        throw MLDB::Exception("Couldn't find resource " + toExtractPath.rawString()
+                            + " in archive " + archiveUri.rawString());
     }
 
     RegisterArchiveHandler()
@@ -13,10 +13,13 @@
 namespace MLDB {
 
 /** Iterate through the given archive (represented by a streambuf),
-    calling the given callback for each object found.
+    calling the given callback for each object found.  If seekable is
+    true, the streambuf must support seeking, which is then used to skip
+    over the parts of the archive that aren't needed.
 */
 bool iterateArchive(std::streambuf * archive,
-                    const OnUriObject & onObject);
+                    const OnUriObject & onObject,
+                    bool seekable = false);
 
 } // namespace MLDB
 
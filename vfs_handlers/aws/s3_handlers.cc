@@ -11,6 +11,9 @@
 #include <exception>
 #include <thread>
 #include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <map>
 #include <boost/iostreams/stream_buffer.hpp>
 #include "mldb/utils/string_functions.h"
 #include "mldb/base/exc_assert.h"
@@ -19,6 +22,7 @@
 #include "mldb/vfs/filter_streams_registry.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/exception_ptr.h"
+#include "mldb/vfs/ranged_streambuf.h"
 #include "mldb/vfs_handlers/aws/s3.h"
 #include "mldb/arch/futex.h"
 
@@ -84,10 +88,7 @@ struct S3UrlFsHandler : public UrlFsHandler {
                 std::string filename = "s3://" + bucket + "/" + prefix + objectName;
                 OpenUriObject open = [=] (const std::map<std::string, std::string> & options) -> UriHandler
                 {
-                    if (!options.empty())
-                        throw MLDB::Exception("Options not accepted by S3");
-
-                    std::shared_ptr<std::istream> result(new filter_istream(filename));
+                    std::shared_ptr<std::istream> result(new filter_istream(filename, options));
                     auto into = getInfo(Url(filename));
 
                     return UriHandler(result->rdbuf(), result, info);
@@ -133,15 +134,32 @@ size_t getTotalSystemMemory()
     return pages * page_size;
 }
 
+/** Tuning of an S3 download, set from the "part-size" and "num-requests"
+    options of filter_istream.  The object is downloaded with that many
+    ranged GETs in flight at once, which are read in sequence.
+
+    The "start-offset" and "end-offset" options restrict the stream to
+    that byte range of the object (the end being exclusive), which allows
+    callers to read parts of a large object without downloading it all.
+*/
+struct S3DownloadOptions {
+    size_t partSize = 0;       ///< Size of each GET; 0 ramps up from 1MB
+    unsigned numRequests = 0;  ///< GETs in flight; 0 depends on object size
+    ssize_t startOffset = 0;   ///< First byte of the object to read
+    ssize_t endOffset = -1;    ///< One past the last byte; -1 is the end
+};
+
 struct S3Downloader {
     S3Downloader(const S3Api * api,
                  const string & bucket,
                  const string & resource, // starts with "/", unescaped (buggy)
+                 const S3DownloadOptions & options = S3DownloadOptions(),
                  ssize_t startOffset = 0, ssize_t endOffset = -1)
         : api(api),
           bucket(bucket), resource(resource),
           offset(startOffset),
           baseChunkSize(1024*1024), // start with 1MB and ramp up
+          fixedChunkSize(options.partSize),
           closed(false),
           readOffset(0),
           readPartOffset(-1),
@@ -158,6 +176,10 @@ struct S3Downloader {
         if (endOffset == -1 || endOffset > fileInfo.size) {
             endOffset = fileInfo.size;
         }
+        if (startOffset > endOffset) {
+            throw MLDB::Exception("download range starts past the end of "
+                                  + resource);
+        }
         downloadSize = endOffset - startOffset;
 
         /* Maximum chunk size is what we can do in 3 seconds, up to 1% of
@@ -169,12 +191,14 @@ struct S3Downloader {
         /* The maximum number of concurrent requests is set depending on
            the total size of the stream. */
         maxRqs = 1;
-        if (fileInfo.size > 1024 * 1024)
+        if (downloadSize > 1024 * 1024)
             maxRqs = 5;
-        if (fileInfo.size > 16 * 1024 * 1024)
+        if (downloadSize > 16 * 1024 * 1024)
             maxRqs = 15;
-        if (fileInfo.size > 256 * 1024 * 1024)
+        if (downloadSize > 256 * 1024 * 1024)
             maxRqs = 30;
+        if (options.numRequests > 0)
+            maxRqs = options.numRequests;
         chunks.resize(maxRqs);
 
         /* Kick start the requests */
@@ -360,8 +384,8 @@ private:
     {
         size_t chunkSize = getChunkSize(currentRq);
         uint64_t end = requestedBytes + chunkSize;
-        if (end > fileInfo.size) {
-            end = fileInfo.size;
+        if (end > downloadSize) {
+            end = downloadSize;
             chunkSize = end - requestedBytes;
         }
 
@@ -422,6 +446,8 @@ private:
     size_t getChunkSize(unsigned int chunkNbr)
         const
     {
+        if (fixedChunkSize > 0)
+            return fixedChunkSize;
         size_t chunkSize = std::min(baseChunkSize * (1 << (chunkNbr / 2)),
                                     maxChunkSize);
         return chunkSize;
@@ -436,6 +462,7 @@ private:
                       * is started */
     uint64_t downloadSize; /* total number of bytes to download */
     size_t baseChunkSize;
+    size_t fixedChunkSize; /* size of every chunk if set by the options */
     size_t maxChunkSize;
 
     bool closed; /* whether close() was invoked */
@@ -466,14 +493,17 @@ private:
 /****************************************************************************/
 
 struct StreamingDownloadSource {
-    StreamingDownloadSource(const std::string & urlStr)
+    StreamingDownloadSource(const std::string & urlStr,
+                            const S3DownloadOptions & options)
     {
         owner = getS3ApiForUri(urlStr);
 
         string bucket, resource;
         std::tie(bucket, resource) = S3Api::parseUri(urlStr);
         downloader.reset(new S3Downloader(owner.get(),
-                                          bucket, "/" + resource));
+                                          bucket, "/" + resource, options,
+                                          options.startOffset,
+                                          options.endOffset));
     }
 
     const FsObjectInfo & info()
@@ -513,16 +543,66 @@ private:
 
 
 std::pair<std::unique_ptr<std::streambuf>, FsObjectInfo>
-makeStreamingDownload(const std::string & uri)
+makeStreamingDownload(const std::string & uri,
+                      const S3DownloadOptions & options)
 {
     std::unique_ptr<std::streambuf> result;
-    StreamingDownloadSource source(uri);
+    StreamingDownloadSource source(uri, options);
     result.reset(new boost::iostreams::stream_buffer<StreamingDownloadSource>
                  (source,131072));
     return make_pair(std::move(result), source.info());
 }
 
 
+/** Open the object for random access, with a ranged GET for each run of
+    blocks that is read.  Like the streaming download, a change of etag
+    while the object is being read is an error.
+*/
+std::pair<std::unique_ptr<std::streambuf>, FsObjectInfo>
+makeRangedDownload(const std::string & uri,
+                   const RangedReadOptions & options)
+{
+    std::shared_ptr<S3Api> api = getS3ApiForUri(uri);
+
+    string bucket, object;
+    std::tie(bucket, object) = S3Api::parseUri(uri);
+    string resource = "/" + object;
+
+    FsObjectInfo info = api->getObjectInfo(bucket, object);
+    if (!info) {
+        throw MLDB::Exception("missing object: " + uri);
+    }
+    string etag = info.etag;
+
+    auto fetch = [api, bucket, resource, etag] (uint64_t offset,
+                                                uint64_t length)
+        {
+            if (length == 0)
+                return std::string();
+            S3Api::Response response
+                = api->get(bucket, resource, S3Api::Range(offset, length));
+            if (response.code_ != 200 && response.code_ != 206) {
+                throw MLDB::Exception("http error "
+                                      + to_string(response.code_)
+                                      + " while getting range "
+                                      + response.bodyXmlStr());
+            }
+            string chunkEtag = response.getHeader("etag");
+            if (chunkEtag != etag) {
+                throw MLDB::Exception("range etag '%s' differs from original"
+                                      " etag '%s' of file '%s'",
+                                      chunkEtag.c_str(), etag.c_str(),
+                                      resource.c_str());
+            }
+            return std::move(response.body_);
+        };
+
+    std::unique_ptr<std::streambuf> result
+        (new RangedReadStreambuf(info.size, fetch, options));
+    return make_pair(std::move(result), std::move(info));
+}
+
+
 /****************************************************************************/
 /* S3 UPLOADER                                                              */
 /****************************************************************************/
@@ -547,18 +627,36 @@ inline void touch(const char * start, size_t size)
 }
 
 
+/** Tuning of an S3 upload, set from the "part-size" and "part-retries"
+    options of filter_ostream (the number of parts in flight being the
+    "num-requests" option, kept in the object metadata).
+
+    The writer fills one part while the others are uploaded, and only
+    blocks once all of the part buffers are in flight.  A part whose
+    upload fails for good is sent again up to numPartRetries times before
+    the upload as a whole fails, since the HTTP layer only retries the
+    errors it knows to be transient.
+*/
+struct S3UploadOptions {
+    size_t partSize = 0;         ///< Size of each part; 0 ramps up from 8MB
+    unsigned numPartRetries = 3; ///< New attempts for a failed part
+};
+
 struct S3Uploader {
     S3Uploader(const S3Api * api,
                const string & bucket,
                const string & resource, // starts with "/", unescaped (buggy)
                const OnUriHandlerException & excCallback,
-               const S3Api::ObjectMetadata & objectMetadata)
+               const S3Api::ObjectMetadata & objectMetadata,
+               const S3UploadOptions & options = S3UploadOptions())
         : api(api),
           bucket(bucket), resource(resource),
           metadata(objectMetadata),
           onException(excCallback),
+          numPartRetries(options.numPartRetries),
           closed(false),
           chunkSize(8 * 1024 * 1024), // start with 8MB and ramp up
+          fixedChunkSize(options.partSize > 0),
           currentRq(0),
           activeRqs(0)
     {
@@ -568,6 +666,17 @@ struct S3Uploader {
         size_t sysMemory = getTotalSystemMemory();
         maxChunkSize = std::min(maxChunkSize, sysMemory / 100);
 
+        if (fixedChunkSize) {
+            /* S3 refuses parts under 5MB, except for the last one */
+            if (options.partSize < 5 * 1024 * 1024) {
+                throw MLDB::Exception("S3 upload parts must be at least 5MB");
+            }
+            chunkSize = maxChunkSize = options.partSize;
+        }
+        if (metadata.numRequests < 1) {
+            metadata.numRequests = 1;
+        }
+
         try {
             S3Api::MultiPartUpload upload
               = api->obtainMultiPartUpload(bucket, resource, metadata,
@@ -580,6 +689,8 @@ struct S3Uploader {
             }
             throw;
         }
+
+        current = getBuffer();
     }
 
     ~S3Uploader()
@@ -599,7 +710,7 @@ struct S3Uploader {
 
         touch(s, n);
 
-        size_t remaining = chunkSize - current.size();
+        size_t remaining = chunkSize - current->size();
         while (n > 0) {
             if (excPtrHandler.hasException() && onException) {
                 onException(current_exception());
@@ -608,9 +719,9 @@ struct S3Uploader {
             size_t toDo = min(remaining, (size_t) n);
             if (toDo < n) {
                 flush();
-                remaining = chunkSize - current.size();
+                remaining = chunkSize - current->size();
             }
-            current.append(s, toDo);
+            current->append(s, toDo);
             s += toDo;
             n -= toDo;
             done += toDo;
@@ -623,69 +734,34 @@ struct S3Uploader {
     void flush(bool force = false)
     {
         if (!force) {
-            ExcAssert(current.size() > 0);
+            ExcAssert(current->size() > 0);
         }
-        while (activeRqs == metadata.numRequests) {
-            MLDB::futex_wait(activeRqs, activeRqs);
-        }
-        if (excPtrHandler.hasException() && onException) {
-            onException(current_exception());
-        }
-        excPtrHandler.rethrowIfSet();
-
-        unsigned int rqNbr(currentRq);
-        auto onResponse = [&, rqNbr] (S3Api::Response && response,
-                                      std::exception_ptr excPtr) {
-            this->handleResponse(rqNbr, std::move(response), excPtr);
-        };
 
-        unsigned int partNumber = currentRq + 1;
-        if (etags.size() < partNumber) {
-            etags.resize(partNumber);
-        }
+        auto part = std::make_shared<Part>();
+        part->number = currentRq + 1;
+        part->data = std::move(current);
 
         activeRqs++;
-        api->putAsync(onResponse, bucket, resource,
-                      MLDB::format("partNumber=%d&uploadId=%s",
-                                 partNumber, uploadId),
-                      {}, {}, current);
+        sendPart(part);
 
-        if (currentRq % 5 == 0 && chunkSize < maxChunkSize)
+        if (!fixedChunkSize && currentRq % 5 == 0 && chunkSize < maxChunkSize)
             chunkSize *= 2;
 
-        current.clear();
-        currentRq = partNumber;
-    }
+        currentRq = part->number;
 
-    void handleResponse(unsigned int rqNbr,
-                        S3Api::Response && response,
-                        std::exception_ptr excPtr)
-    {
-        try {
-            if (excPtr) {
-                rethrow_exception(excPtr);
-            }
-
-            if (response.code_ != 200) {
-                cerr << response.bodyXmlStr() << endl;
-                throw MLDB::Exception("put didn't work: %d", (int)response.code_);
-            }
-
-            string etag = response.getHeader("etag");
-            ExcAssert(etag.size() > 0);
-            etags[rqNbr] = etag;
-        }
-        catch (const std::exception & exc) {
-            excPtrHandler.takeCurrentException();
+        /* Wait for a free buffer to fill the next part.  This is the only
+           place where the writer blocks on the uploads. */
+        current = getBuffer();
+        if (excPtrHandler.hasException() && onException) {
+            onException(current_exception());
         }
-        activeRqs--;
-        MLDB::futex_wake(activeRqs);
+        excPtrHandler.rethrowIfSet();
     }
 
     string close()
     {
         closed = true;
-        if (current.size() > 0) {
+        if (current->size() > 0) {
             flush();
         }
         else if (currentRq == 0) {
@@ -702,8 +778,14 @@ struct S3Uploader {
 
         string finalEtag;
         try {
+            std::vector<std::string> partEtags(etags.size());
+            for (auto & e: etags) {
+                ExcAssertGreater(e.first, 0);
+                ExcAssertLessEqual(e.first, partEtags.size());
+                partEtags[e.first - 1] = std::move(e.second);
+            }
             finalEtag = api->finishMultiPartUpload(bucket, resource,
-                                                   uploadId, etags);
+                                                   uploadId, partEtags);
         }
         MLDB_CATCH_ALL {
             if (onException) {
@@ -716,11 +798,120 @@ struct S3Uploader {
     }
 
 private:
+    typedef std::unique_ptr<std::string> Buffer;
+
+    /* A part being uploaded, which keeps its data until S3 acknowledges it
+       so that it can be sent again. */
+    struct Part {
+        unsigned int number;
+        Buffer data;
+        unsigned int attempts = 0;
+    };
+
+    /* Return an empty buffer to fill, waiting for one to be released when
+       all of them are in flight.  There are numRequests + 1 of them: one
+       for each part in flight and the one being filled. */
+    Buffer getBuffer()
+    {
+        std::unique_lock<std::mutex> guard(buffersLock);
+        buffersCond.wait(guard, [&] () {
+            return !freeBuffers.empty()
+                || numBuffers <= metadata.numRequests
+                || excPtrHandler.hasException();
+        });
+        Buffer result;
+        if (!freeBuffers.empty()) {
+            result = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+            result->clear();
+        }
+        else {
+            result.reset(new std::string());
+            numBuffers++;
+        }
+        if (result->capacity() < chunkSize) {
+            result->reserve(chunkSize);
+        }
+        return result;
+    }
+
+    void releaseBuffer(Buffer buffer)
+    {
+        std::unique_lock<std::mutex> guard(buffersLock);
+        freeBuffers.emplace_back(std::move(buffer));
+        buffersCond.notify_one();
+    }
+
+    void sendPart(const std::shared_ptr<Part> & part)
+    {
+        auto onResponse = [this, part] (S3Api::Response && response,
+                                        std::exception_ptr excPtr) {
+            this->handleResponse(part, std::move(response), excPtr);
+        };
+
+        part->attempts++;
+        api->putAsync(onResponse, bucket, resource,
+                      MLDB::format("partNumber=%d&uploadId=%s",
+                                   part->number, uploadId),
+                      {}, {}, *part->data);
+    }
+
+    void handleResponse(const std::shared_ptr<Part> & part,
+                        S3Api::Response && response,
+                        std::exception_ptr excPtr)
+    {
+        try {
+            if (excPtr) {
+                rethrow_exception(excPtr);
+            }
+
+            if (response.code_ != 200) {
+                cerr << response.bodyXmlStr() << endl;
+                throw MLDB::Exception("put didn't work: %d", (int)response.code_);
+            }
+
+            string etag = response.getHeader("etag");
+            if (etag.empty()) {
+                throw MLDB::Exception("no etag returned for part %d",
+                                      part->number);
+            }
+
+            {
+                std::unique_lock<std::mutex> guard(etagsLock);
+                etags[part->number] = etag;
+            }
+            releaseBuffer(std::move(part->data));
+        }
+        catch (const std::exception & exc) {
+            if (part->attempts <= numPartRetries
+                && !excPtrHandler.hasException()) {
+                cerr << "retrying upload of part " << part->number
+                     << " of " << bucket << resource << ": "
+                     << exc.what() << endl;
+                try {
+                    sendPart(part);
+                    return;
+                }
+                MLDB_CATCH_ALL {
+                }
+            }
+            excPtrHandler.takeCurrentException();
+
+            /* wake up a writer waiting for a buffer so that it sees the
+               exception */
+            std::unique_lock<std::mutex> guard(buffersLock);
+            buffersCond.notify_all();
+        }
+        activeRqs--;
+        MLDB::futex_wake(activeRqs);
+    }
+
     const S3Api * api;
     std::string bucket;
     std::string resource;
     S3Api::ObjectMetadata metadata;
     OnUriHandlerException onException;
+    unsigned int numPartRetries;
 
     size_t maxChunkSize;
     std::string uploadId;
@@ -729,11 +920,19 @@ private:
     bool closed; /* whether close() was invoked */
     ExceptionPtrHandler excPtrHandler; /* TODO: use promise/future instead */
 
-    string current; /* current chunk data */
+    Buffer current; /* current chunk data */
     size_t chunkSize; /* current chunk size */
-    std::vector<std::string> etags; /* etags of individual chunks */
+    bool fixedChunkSize; /* whether the "part-size" option was given */
     unsigned int currentRq;  /* number of done requests */
     atomic<unsigned int> activeRqs; /* number of pending http requests */
+
+    std::mutex buffersLock;
+    std::condition_variable buffersCond;
+    std::vector<Buffer> freeBuffers; /* buffers of uploaded parts */
+    unsigned int numBuffers = 0; /* buffers allocated so far */
+
+    std::mutex etagsLock;
+    std::map<unsigned int, std::string> etags; /* etags by part number */
 };
 
 
@@ -744,13 +943,14 @@ private:
 struct StreamingUploadSource {
     StreamingUploadSource(const std::string & urlStr,
                           const OnUriHandlerException & excCallback,
-                          const S3Api::ObjectMetadata & metadata)
+                          const S3Api::ObjectMetadata & metadata,
+                          const S3UploadOptions & options)
         : owner(getS3ApiForUri(urlStr))
     {
         string bucket, resource;
         std::tie(bucket, resource) = S3Api::parseUri(urlStr);
         uploader.reset(new S3Uploader(owner.get(), bucket, "/" + resource,
-                                      excCallback, metadata));
+                                      excCallback, metadata, options));
     }
 
     typedef char char_type;
@@ -785,11 +985,12 @@ private:
 std::unique_ptr<std::streambuf>
 makeStreamingUpload(const std::string & uri,
                     const OnUriHandlerException & onException,
-                    const S3Api::ObjectMetadata & metadata)
+                    const S3Api::ObjectMetadata & metadata,
+                    const S3UploadOptions & options = S3UploadOptions())
 {
     std::unique_ptr<std::streambuf> result;
     result.reset(new boost::iostreams::stream_buffer<StreamingUploadSource>
-                 (StreamingUploadSource(uri, onException, metadata),
+                 (StreamingUploadSource(uri, onException, metadata, options),
                   131072));
     return result;
 }
@@ -812,9 +1013,48 @@ struct RegisterS3Handler {
         string bucket(resource, 0, pos);
 
         if (mode == ios::in) {
+            S3DownloadOptions dlOptions;
+            for (auto & opt: options) {
+                const string & name = opt.first;
+                const string & value = opt.second;
+                if (name == "part-size") {
+                    dlOptions.partSize = std::stoull(value);
+                }
+                else if (name == "num-requests") {
+                    dlOptions.numRequests = std::stoi(value);
+                    if (dlOptions.numRequests < 1)
+                        throw MLDB::Exception("num-requests must be at least"
+                                              " 1 reading S3 object "
+                                              + resource);
+                }
+                else if (name == "start-offset") {
+                    dlOptions.startOffset = std::stoll(value);
+                }
+                else if (name == "end-offset") {
+                    dlOptions.endOffset = std::stoll(value);
+                }
+            }
+
+            if (dlOptions.startOffset < 0
+                || (dlOptions.endOffset != -1
+                    && dlOptions.endOffset < dlOptions.startOffset))
+                throw MLDB::Exception("invalid byte range reading S3 object "
+                                      + resource);
+
+            RangedReadOptions rangedOptions;
+            if (parseRangedReadOptions(options, rangedOptions)) {
+                auto dl = makeRangedDownload("s3://" + resource,
+                                             rangedOptions);
+                std::shared_ptr<std::streambuf> buf(dl.first.release());
+                UriHandlerOptions handlerOptions;
+                handlerOptions.isForwardSeekable = true;
+                handlerOptions.isRandomSeekable = true;
+                return UriHandler(buf.get(), buf, dl.second, handlerOptions);
+            }
+
             std::unique_ptr<std::streambuf> source;
             FsObjectInfo info;
-            auto dl = makeStreamingDownload("s3://" + resource);
+            auto dl = makeStreamingDownload("s3://" + resource, dlOptions);
             source = std::move(dl.first);
             info = std::move(dl.second);
             std::shared_ptr<std::streambuf> buf(source.release());
@@ -823,6 +1063,7 @@ struct RegisterS3Handler {
         else if (mode == ios::out) {
 
             S3Api::ObjectMetadata md;
+            S3UploadOptions ulOptions;
             for (auto & opt: options) {
                 string name = opt.first;
                 string value = opt.second;
@@ -844,7 +1085,8 @@ struct RegisterS3Handler {
                     md.acl = value;
                 }
                 else if (name == "mode" || name == "compression"
-                         || name == "compressionLevel") {
+                         || name == "compressionLevel"
+                         || name == "compressionThreads") {
                     // do nothing
                 }
                 else if (name.find("aws-") == 0) {
@@ -860,6 +1102,16 @@ struct RegisterS3Handler {
                 else if(name == "num-requests")
                 {
                     md.numRequests = std::stoi(value);
+                    if (md.numRequests < 1)
+                        throw MLDB::Exception("num-requests must be at least"
+                                              " 1 writing S3 object "
+                                              + resource);
+                }
+                else if (name == "part-size") {
+                    ulOptions.partSize = std::stoull(value);
+                }
+                else if (name == "part-retries") {
+                    ulOptions.numPartRetries = std::stoi(value);
                 }
                 else {
                     cerr << "warning: skipping unknown S3 option "
@@ -868,7 +1120,8 @@ struct RegisterS3Handler {
             }
 
             std::shared_ptr<std::streambuf> buf
-                (makeStreamingUpload("s3://" + resource, onException, md).release());
+                (makeStreamingUpload("s3://" + resource, onException, md,
+                                     ulOptions).release());
             return UriHandler(buf.get(), buf);
         }
         else throw MLDB::Exception("no way to create s3 handler for non in/out");
@@ -26,7 +26,9 @@
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/credentials/credential_provider.h"
+#include "mldb/base/parallel.h"
 #include <thread>
+#include <condition_variable>
 #include <unordered_map>
 
 
@@ -878,12 +880,12 @@ streamingDownload(const std::string & path) const
 
 std::unique_ptr<std::streambuf>
 SftpConnection::
-streamingDownloadStreambuf(const std::string & path) const
+streamingDownloadStreambuf(const std::string & path, size_t readSize) const
 {
     std::unique_ptr<std::streambuf> result;
     result.reset(new boost::iostreams::stream_buffer<SftpStreamingDownloadSource>
                  (SftpStreamingDownloadSource(this, path),
-                  131072));
+                  readSize));
     return result;
 }
 
@@ -903,14 +905,171 @@ mkdir(const string & path) const {
 
 namespace {
 
+/** Maximum number of pooled connections per host. */
+int sftpMaxConnections()
+{
+    static int result = [] ()
+        {
+            char * maxEnv = getenv("SFTP_MAX_CONNECTIONS");
+            return maxEnv ? std::max(1, atoi(maxEnv)) : 4;
+        }();
+    return result;
+}
+
+/** Pool of connections to a host, for acquireSftpConnection(). */
+struct SftpConnectionPool
+    : public std::enable_shared_from_this<SftpConnectionPool> {
+
+    typedef std::function<std::shared_ptr<SftpConnection> ()> Connect;
+
+    SftpConnectionPool(Connect connect)
+        : connect(std::move(connect)),
+          maxConnections(sftpMaxConnections()), numOpen(0)
+    {
+    }
+
+    std::shared_ptr<const SftpConnection> acquire()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        for (;;) {
+            while (!idle.empty()) {
+                auto connection = std::move(idle.back());
+                idle.pop_back();
+                guard.unlock();
+                if (connection->isAlive()) {
+                    return lend(std::move(connection));
+                }
+                connection.reset();
+                guard.lock();
+                --numOpen;
+            }
+
+            if (numOpen < maxConnections) {
+                ++numOpen;
+                guard.unlock();
+                try {
+                    return lend(connect());
+                } MLDB_CATCH_ALL {
+                    guard.lock();
+                    --numOpen;
+                    available.notify_one();
+                    throw;
+                }
+            }
+
+            available.wait(guard);
+        }
+    }
+
+    /** Opens a new connection to the host. */
+    Connect connect;
+
+private:
+    std::shared_ptr<const SftpConnection>
+    lend(std::shared_ptr<SftpConnection> connection)
+    {
+        auto pool = shared_from_this();
+        SftpConnection * ptr = connection.get();
+        return std::shared_ptr<const SftpConnection>
+            (ptr,
+             [pool, connection] (const SftpConnection *) mutable
+             {
+                 std::unique_lock<std::mutex> guard(pool->lock);
+                 pool->idle.emplace_back(std::move(connection));
+                 pool->available.notify_one();
+             });
+    }
+
+    int maxConnections;
+    std::mutex lock;
+    std::condition_variable available;
+    std::vector<std::shared_ptr<SftpConnection> > idle;
+    int numOpen;  ///< Pooled connections, idle or lent out
+};
+
 struct SftpHostInfo {
     std::string sftpHost;
     std::shared_ptr<SftpConnection> connection;  //< Used to access this uri
+    std::shared_ptr<SftpConnectionPool> pool;    //< For concurrent transfers
 };
 
 std::mutex sftpHostsLock;
 std::unordered_map<std::string, SftpHostInfo> sftpHosts;
 
+void registerSftpHost(const std::string & hostname,
+                      SftpConnectionPool::Connect connect)
+{
+    std::unique_lock<std::mutex> guard(sftpHostsLock);
+    if (sftpHosts.count(hostname)){
+        throw HostAlreadyRegistered(hostname);
+    }
+
+    SftpHostInfo info;
+    info.sftpHost = hostname;
+    info.connection = connect();
+    info.pool = std::make_shared<SftpConnectionPool>(std::move(connect));
+    sftpHosts[hostname] = info;
+}
+
+/** Return the information for the given host, connecting to it with the
+    sftp credentials if it isn't registered or its connection died.  The
+    sftpHostsLock must be held.
+*/
+SftpHostInfo & getHostInfo(const std::string & connStr)
+{
+    auto it = sftpHosts.find(connStr);
+    if (it != sftpHosts.end() && it->second.connection.get()->isAlive()) {
+        return it->second;
+    }
+
+    SftpConnectionPool::Connect connect;
+    if (it != sftpHosts.end()) {
+        // Reconnect the same way as before
+        connect = it->second.pool->connect;
+    }
+    else {
+        auto creds = getCredential("sftp", "sftp://" + connStr);
+
+        const auto pos = connStr.find(":");
+        string host;
+        string port;
+        if (pos == string::npos) {
+            host = connStr;
+            port = "ssh";
+        }
+        else {
+            host = connStr.substr(0, pos);
+            port = connStr.substr(pos + 1);
+        }
+
+        connect = [=] ()
+            {
+                auto result = std::make_shared<SftpConnection>();
+                result->connectPasswordAuth(host, creds.id, creds.secret,
+                                            port);
+                return result;
+            };
+    }
+
+    SftpHostInfo info;
+    info.sftpHost = connStr.substr(0, connStr.find(":"));
+    info.connection = connect();
+    info.pool = (it != sftpHosts.end()
+                 ? it->second.pool
+                 : std::make_shared<SftpConnectionPool>(connect));
+    return sftpHosts[connStr] = info;
+}
+
+FsObjectInfo infoFromAttributes(const SftpConnection::Attributes & attr)
+{
+    FsObjectInfo info;
+    info.exists = true;
+    info.size = attr.filesize;
+    info.ownerId = std::to_string(attr.uid);
+    info.lastModified = Date::fromSecondsSinceEpoch(attr.mtime);
+    return info;
+}
+
 } // file scope
 
 /** Sftp support for filter_ostream opens.  Register the host name here, and
@@ -922,17 +1081,12 @@ void registerSftpHostPassword(const std::string & hostname,
                               const std::string & password,
                               const std::string & port)
 {
-    std::unique_lock<std::mutex> guard(sftpHostsLock);
-    if (sftpHosts.count(hostname)){
-        throw HostAlreadyRegistered(hostname);
-    }
-
-    SftpHostInfo info;
-    info.sftpHost = hostname;
-    info.connection = std::make_shared<SftpConnection>();
-    info.connection->connectPasswordAuth(hostname, username, password, port);
-    
-    sftpHosts[hostname] = info;
+    registerSftpHost(hostname, [=] ()
+        {
+            auto result = std::make_shared<SftpConnection>();
+            result->connectPasswordAuth(hostname, username, password, port);
+            return result;
+        });
 }
 
 void registerSftpHostPublicKey(const std::string & hostname,
@@ -941,19 +1095,15 @@ void registerSftpHostPublicKey(const std::string & hostname,
                                const std::string & privateKeyFile,
                                const std::string & port)
 {
-    std::unique_lock<std::mutex> guard(sftpHostsLock);
-    if (sftpHosts.count(hostname)){
-        throw HostAlreadyRegistered(hostname);
-    }
-
-    SftpHostInfo info;
-    info.sftpHost = hostname;
-    info.connection = std::make_shared<SftpConnection>();
-    info.connection->connectPublicKeyAuth(hostname, username,
-                                          publicKeyFile,
-                                          privateKeyFile,
-                                          port);
-    sftpHosts[hostname] = info;
+    registerSftpHost(hostname, [=] ()
+        {
+            auto result = std::make_shared<SftpConnection>();
+            result->connectPublicKeyAuth(hostname, username,
+                                         publicKeyFile,
+                                         privateKeyFile,
+                                         port);
+            return result;
+        });
 }
 
 struct RegisterSftpHandler {
@@ -971,31 +1121,45 @@ struct RegisterSftpHandler {
                                 + resource);
         string connStr(resource, 0, pos);
 
-        const auto & connection = getSftpConnectionFromConnStr(connStr);
+        // Each stream has its own connection, so that several can be
+        // transferred at once
+        auto connection = acquireSftpConnection(connStr);
         string path = resource.substr(connStr.size());
-        if (mode == ios::in) {
-            std::shared_ptr<std::streambuf> buf
-                (connection.streamingDownloadStreambuf(path).release());
 
+        // The stream buffer is destroyed, closing the file, before the
+        // connection is released
+        typedef std::pair<std::shared_ptr<const SftpConnection>,
+                          std::shared_ptr<std::streambuf> > Owner;
+
+        if (mode == ios::in) {
             SftpConnection::Attributes attr;
-            if (!connection.getAttributes(path, attr)) {
+            if (!connection->getAttributes(path, attr)) {
                 throw MLDB::Exception("Couldn't read attributes for sftp "
                                     "resource");
             }
 
-            auto info = std::make_shared<FsObjectInfo>();
-            info->exists = true;
-            info->size = attr.filesize;
-            info->ownerId = std::to_string(attr.uid);
-            info->lastModified = Date::fromSecondsSinceEpoch(attr.mtime);
+            size_t readSize = 2 * 1024 * 1024;
+            auto it = options.find("read-size");
+            if (it != options.end()) {
+                readSize = std::stoull(it->second);
+            }
+
+            std::shared_ptr<std::streambuf> buf
+                (connection->streamingDownloadStreambuf(path, readSize)
+                 .release());
+            auto owner = std::make_shared<Owner>(connection, buf);
 
-            return UriHandler(buf.get(), buf, info);
+            auto info = std::make_shared<FsObjectInfo>
+                (infoFromAttributes(attr));
+
+            return UriHandler(buf.get(), owner, info);
         }
         if (mode == ios::out) {
             std::shared_ptr<std::streambuf> buf
-                (connection.streamingUploadStreambuf(path, onException)
+                (connection->streamingUploadStreambuf(path, onException)
                  .release());
-            return UriHandler(buf.get(), buf);
+            auto owner = std::make_shared<Owner>(connection, buf);
+            return UriHandler(buf.get(), owner);
         }
         throw MLDB::Exception("no way to create sftp handler for non in/out");
     }
@@ -1010,31 +1174,18 @@ struct RegisterSftpHandler {
 const SftpConnection & getSftpConnectionFromConnStr(const std::string & connStr)
 {
     std::unique_lock<std::mutex> guard(sftpHostsLock);
-    auto it = sftpHosts.find(connStr);
-    if (it != sftpHosts.end() && it->second.connection.get()->isAlive()) {
-        return *it->second.connection.get();
-    }
-    auto creds = getCredential("sftp", "sftp://" + connStr);
+    return *getHostInfo(connStr).connection;
+}
 
-    const auto pos = connStr.find(":");
-    string host;
-    string port;
-    if (pos == string::npos) {
-        host = connStr;
-        port = "ssh";
-    }
-    else {
-        host = connStr.substr(0, pos);
-        port = connStr.substr(pos + 1);
+std::shared_ptr<const SftpConnection>
+acquireSftpConnection(const std::string & connStr)
+{
+    std::shared_ptr<SftpConnectionPool> pool;
+    {
+        std::unique_lock<std::mutex> guard(sftpHostsLock);
+        pool = getHostInfo(connStr).pool;
     }
-
-
-    SftpHostInfo info;
-    info.sftpHost = host;
-    info.connection = std::make_shared<SftpConnection>();
-    info.connection->connectPasswordAuth(host, creds.id, creds.secret, port);
-    sftpHosts[connStr] = info;
-    return *info.connection.get();
+    return pool->acquire();
 }
 
 namespace {
@@ -1050,30 +1201,26 @@ string connStrFromUri(const string & uri) {
 
 struct SftpUrlFsHandler : public UrlFsHandler {
 
-    UriHandler getUriHandler(const Url & url) const
-    {
-        string urlStr = url.toDecodedString();
-        ExcAssert(urlStr.find("sftp://") == 0);
-        const std::map<std::string, std::string> options;
-        return RegisterSftpHandler::getSftpHandler(
-            "", urlStr.substr(7), ios::in, options, nullptr);
-    }
-
     FsObjectInfo getInfo(const Url & url) const override
     {
-        const auto handler = getUriHandler(url);
-        return std::move(*(handler.info.get()));
+        auto info = tryGetInfo(url);
+        if (!info) {
+            throw MLDB::Exception("Couldn't read attributes for sftp "
+                                  "resource " + url.toString());
+        }
+        return info;
     }
 
     FsObjectInfo tryGetInfo(const Url & url) const override
     {
-        try {
-            const auto handler = getUriHandler(url);
-            return std::move(*(handler.info.get()));
-        }
-        catch (const MLDB::Exception & exc) {
+        string urlStr = url.toDecodedString();
+        string connStr = connStrFromUri(urlStr);
+        auto conn = acquireSftpConnection(connStr);
+        SftpConnection::Attributes attr;
+        if (!conn->getAttributes(urlStr.substr(7 + connStr.size()), attr)) {
+            return FsObjectInfo();
         }
-        return FsObjectInfo();
+        return infoFromAttributes(attr);
     }
 
     void makeDirectory(const Url & url) const override
@@ -1102,6 +1249,11 @@ struct SftpUrlFsHandler : public UrlFsHandler {
         return res == 0;
     }
 
+    /** The directories of each level of the tree are listed in parallel,
+        over pooled connections, and the callbacks are then called in
+        order on this thread.  The attributes that come with the listing
+        are used for the objects' info, so there is no round trip per file.
+    */
     bool forEach(const Url & prefix,
                  const OnUriObject & onObject,
                  const OnUriSubdir & onSubdir,
@@ -1111,45 +1263,65 @@ struct SftpUrlFsHandler : public UrlFsHandler {
         ExcAssert(delimiter == "/");
         string url = prefix.toString();
         const string connStr = connStrFromUri(url);
-        const auto & conn = getSftpConnectionFromConnStr(connStr);
-
-        function<void(string, int)> processPath = [&] (string path, int depth) {
-            auto dir = conn.getDirectory(path);
-            dir.forEachFile([&] (string name, SftpConnection::Attributes attr) {
-                // For help with masks see
-                // https://github.com/libssh2/libssh2/blob/master/docs/libssh2_sftp_fstat_ex.3
-                string currUri = "sftp://" + connStr + path + "/" + name;
-                if (LIBSSH2_SFTP_S_ISREG (attr.permissions)) {
-                    OpenUriObject open = [=] (const std::map<std::string, std::string> & options) -> UriHandler
-                    {
-                        if (!options.empty()) {
-                            throw MLDB::Exception("Options not accepted by S3");
-                        }
 
-                        std::shared_ptr<std::istream> result(
-                            new filter_istream(currUri));
-                        auto info = getInfo(Url(currUri));
-
-                        return UriHandler(result->rdbuf(), result, info);
-                    };
-                    onObject(currUri, getInfo(Url(currUri)), open, 1);
-                    return;
-                }
-                if (LIBSSH2_SFTP_S_ISDIR (attr.permissions)) {
-                    if (name == ".." || name == ".") {
-                        return;
+        typedef std::vector<std::pair<string, SftpConnection::Attributes> >
+            Listing;
+
+        auto listDirectory = [&] (const string & path)
+            {
+                Listing result;
+                auto conn = acquireSftpConnection(connStr);
+                conn->getDirectory(path).forEachFile
+                    ([&] (string name, SftpConnection::Attributes attr)
+                     {
+                         result.emplace_back(std::move(name), attr);
+                     });
+                return result;
+            };
+
+        std::vector<string> level = { url.substr(7 + connStr.size()) };
+
+        for (int depth = 0;  !level.empty();  ++depth) {
+            std::vector<Listing> listings(level.size());
+            parallelMap(0, level.size(),
+                        [&] (size_t i) { listings[i] = listDirectory(level[i]); },
+                        sftpMaxConnections());
+
+            std::vector<string> nextLevel;
+            for (size_t i = 0;  i < level.size();  ++i) {
+                const string & path = level[i];
+                for (auto & entry: listings[i]) {
+                    const string & name = entry.first;
+                    const SftpConnection::Attributes & attr = entry.second;
+
+                    // For help with masks see
+                    // https://github.com/libssh2/libssh2/blob/master/docs/libssh2_sftp_fstat_ex.3
+                    string currUri = "sftp://" + connStr + path + "/" + name;
+                    if (LIBSSH2_SFTP_S_ISREG (attr.permissions)) {
+                        FsObjectInfo info = infoFromAttributes(attr);
+                        OpenUriObject open = [=] (const std::map<std::string, std::string> & options) -> UriHandler
+                        {
+                            std::shared_ptr<std::istream> result(
+                                new filter_istream(currUri, options));
+                            return UriHandler(result->rdbuf(), result, info);
+                        };
+                        if (!onObject(currUri, info, open, 1))
+                            return false;
+                        continue;
                     }
-                    if (onSubdir && onSubdir(currUri, depth)) {
-                        processPath(path + "/" + name, depth + 1);
+                    if (LIBSSH2_SFTP_S_ISDIR (attr.permissions)) {
+                        if (name == ".." || name == ".") {
+                            continue;
+                        }
+                        if (onSubdir && onSubdir(currUri, depth)) {
+                            nextLevel.push_back(path + "/" + name);
+                        }
                     }
-                    return;
                 }
+            }
 
-            });
-        };
-
-        string path = url.substr(7 + connStr.size());
-        processPath(path, 0);
+            level = std::move(nextLevel);
+        }
 
         return true;
     }
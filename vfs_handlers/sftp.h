@@ -154,8 +154,14 @@ struct SftpConnection : public SshConnection {
     streamingUploadStreambuf(const std::string & path,
                              const OnUriHandlerException & onException) const;
 
+    /** Stream the file at the given path.  Reads are made readSize bytes
+        at a time; libssh2 splits each one into as many SFTP read requests
+        as needed and keeps them all in flight, so a larger size hides
+        more of the latency of the link.
+    */
     std::unique_ptr<std::streambuf>
-    streamingDownloadStreambuf(const std::string & path) const;
+    streamingDownloadStreambuf(const std::string & path,
+                               size_t readSize = 2 * 1024 * 1024) const;
 
     filter_ostream streamingUpload(const std::string & path) const;
     filter_istream streamingDownload(const std::string & path) const;
@@ -197,4 +203,15 @@ void registerSftpHostPublicKey(const std::string & hostname,
 
 const SftpConnection & getSftpConnectionFromConnStr(const std::string & connStr);
 
+/** Return a connection to the given host that the caller has for itself
+    until it releases the returned pointer, at which point it goes back
+    to a pool.  A libssh2 session can only be used by one thread at a
+    time, so this is what allows several files of a host to be transferred
+    at once; each pooled connection is its own SSH session.  There are at
+    most SFTP_MAX_CONNECTIONS of them per host (default 4); past that,
+    this waits for one to be released.
+*/
+std::shared_ptr<const SftpConnection>
+acquireSftpConnection(const std::string & connStr);
+
 } // namespace MLDB
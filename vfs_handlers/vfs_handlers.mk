@@ -5,12 +5,15 @@ $(eval $(call include_sub_make,aws))
 LIBVFS_HANDLERS_SOURCES := \
 	sftp.cc \
 	archive.cc \
+	zip_index.cc \
 	docker.cc \
 
 LIBVFS_HANDLERS_LINK := \
 	hash \
+	base \
 	$(LIBARCHIVE_LIB_NAME) \
 	ssh2 \
+	z \
 	aws_vfs_handlers \
 
 $(eval $(call library,vfs_handlers,$(LIBVFS_HANDLERS_SOURCES),$(LIBVFS_HANDLERS_LINK)))
@@ -0,0 +1,330 @@
+/** zip_index.cc
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Index of the members of a zip file, read from its central directory.
+*/
+
+#include "zip_index.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+static constexpr uint32_t EOCD_SIGNATURE = 0x06054b50;
+static constexpr uint32_t ZIP64_EOCD_LOCATOR_SIGNATURE = 0x07064b50;
+static constexpr uint32_t ZIP64_EOCD_SIGNATURE = 0x06064b50;
+static constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+static constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+
+static constexpr size_t EOCD_SIZE = 22;
+static constexpr size_t ZIP64_EOCD_LOCATOR_SIZE = 20;
+static constexpr size_t ZIP64_EOCD_SIZE = 56;
+static constexpr size_t CENTRAL_HEADER_SIZE = 46;
+static constexpr size_t LOCAL_HEADER_SIZE = 30;
+static constexpr size_t MAX_COMMENT_SIZE = 65535;
+
+uint16_t get16(const char * p)
+{
+    const unsigned char * u = (const unsigned char *)p;
+    return u[0] | (u[1] << 8);
+}
+
+uint32_t get32(const char * p)
+{
+    return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+uint64_t get64(const char * p)
+{
+    return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+std::string readAt(std::istream & stream, uint64_t offset, size_t length)
+{
+    std::string result(length, '\0');
+    stream.clear();
+    stream.seekg(offset);
+    stream.read(&result[0], length);
+    if (stream.gcount() != (std::streamsize)length)
+        throw MLDB::Exception("zip file is truncated");
+    return result;
+}
+
+Date fromDosTime(uint16_t time, uint16_t date)
+{
+    if (date == 0)
+        return Date::notADate();
+    return Date(1980 + (date >> 9), (date >> 5) & 15, date & 31,
+                time >> 11, (time >> 5) & 63, (time & 31) * 2);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* ZIP INDEX                                                                 */
+/*****************************************************************************/
+
+FsObjectInfo
+ZipIndex::Entry::
+getInfo() const
+{
+    FsObjectInfo result;
+    result.exists = true;
+    result.size = uncompressedSize;
+    result.lastModified = lastModified;
+    return result;
+}
+
+const ZipIndex::Entry *
+ZipIndex::
+find(const std::string & name) const
+{
+    auto it = byName.find(name);
+    if (it == byName.end())
+        return nullptr;
+    return &entries[it->second];
+}
+
+std::shared_ptr<const ZipIndex>
+ZipIndex::
+read(std::istream & stream, uint64_t size)
+{
+    if (size < EOCD_SIZE)
+        return nullptr;
+
+    // The end of central directory record is at the end of the file,
+    // followed only by a comment
+    uint64_t tailSize = std::min<uint64_t>(size, EOCD_SIZE + MAX_COMMENT_SIZE);
+    std::string tail = readAt(stream, size - tailSize, tailSize);
+
+    ssize_t eocd = -1;
+    for (ssize_t i = tailSize - EOCD_SIZE;  i >= 0;  --i) {
+        if (get32(&tail[i]) == EOCD_SIGNATURE
+            && i + EOCD_SIZE + get16(&tail[i + 20]) <= tailSize) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd == -1)
+        return nullptr;
+
+    const char * p = &tail[eocd];
+    uint64_t numEntries = get16(p + 10);
+    uint64_t cdSize = get32(p + 12);
+    uint64_t cdOffset = get32(p + 16);
+
+    uint64_t eocdOffset = size - tailSize + eocd;
+    if ((numEntries == 0xffff || cdSize == 0xffffffff
+         || cdOffset == 0xffffffff)
+        && eocdOffset >= ZIP64_EOCD_LOCATOR_SIZE) {
+        std::string locator = readAt(stream,
+                                     eocdOffset - ZIP64_EOCD_LOCATOR_SIZE,
+                                     ZIP64_EOCD_LOCATOR_SIZE);
+        if (get32(&locator[0]) == ZIP64_EOCD_LOCATOR_SIGNATURE) {
+            std::string eocd64 = readAt(stream, get64(&locator[8]),
+                                        ZIP64_EOCD_SIZE);
+            if (get32(&eocd64[0]) != ZIP64_EOCD_SIGNATURE)
+                throw MLDB::Exception("zip64 end of central directory not found");
+            numEntries = get64(&eocd64[32]);
+            cdSize = get64(&eocd64[40]);
+            cdOffset = get64(&eocd64[48]);
+        }
+    }
+
+    if (cdOffset + cdSize > size)
+        throw MLDB::Exception("zip central directory is past the end of the "
+                              "file");
+
+    std::string cd = readAt(stream, cdOffset, cdSize);
+
+    auto result = std::make_shared<ZipIndex>();
+    result->entries.reserve(numEntries);
+
+    size_t pos = 0;
+    for (uint64_t i = 0;  i < numEntries;  ++i) {
+        if (pos + CENTRAL_HEADER_SIZE > cd.size()
+            || get32(&cd[pos]) != CENTRAL_HEADER_SIGNATURE)
+            throw MLDB::Exception("zip central directory is corrupt");
+
+        const char * h = &cd[pos];
+        Entry entry;
+        entry.flags = get16(h + 8);
+        entry.method = get16(h + 10);
+        entry.lastModified = fromDosTime(get16(h + 12), get16(h + 14));
+        entry.compressedSize = get32(h + 20);
+        entry.uncompressedSize = get32(h + 24);
+        size_t nameLen = get16(h + 28);
+        size_t extraLen = get16(h + 30);
+        size_t commentLen = get16(h + 32);
+        entry.localHeaderOffset = get32(h + 42);
+
+        if (pos + CENTRAL_HEADER_SIZE + nameLen + extraLen + commentLen
+            > cd.size())
+            throw MLDB::Exception("zip central directory is corrupt");
+
+        entry.name.assign(h + CENTRAL_HEADER_SIZE, nameLen);
+
+        // Sizes and offsets that don't fit are in the zip64 extra field,
+        // in that order, for those that are saturated
+        const char * extra = h + CENTRAL_HEADER_SIZE + nameLen;
+        for (size_t j = 0;  j + 4 <= extraLen;) {
+            uint16_t id = get16(extra + j);
+            size_t len = get16(extra + j + 2);
+            if (id == 1) {
+                const char * f = extra + j + 4;
+                const char * e = f + std::min(len, extraLen - j - 4);
+                if (entry.uncompressedSize == 0xffffffff && f + 8 <= e) {
+                    entry.uncompressedSize = get64(f);  f += 8;
+                }
+                if (entry.compressedSize == 0xffffffff && f + 8 <= e) {
+                    entry.compressedSize = get64(f);  f += 8;
+                }
+                if (entry.localHeaderOffset == 0xffffffff && f + 8 <= e) {
+                    entry.localHeaderOffset = get64(f);  f += 8;
+                }
+            }
+            j += 4 + len;
+        }
+
+        pos += CENTRAL_HEADER_SIZE + nameLen + extraLen + commentLen;
+
+        result->byName[entry.name] = result->entries.size();
+        result->entries.emplace_back(std::move(entry));
+    }
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* ZIP MEMBER STREAMBUF                                                      */
+/*****************************************************************************/
+
+namespace {
+
+struct ZipMemberStreambuf: public std::streambuf {
+    ZipMemberStreambuf(const ZipIndex::Entry & entry,
+                       std::istream & stream,
+                       std::shared_ptr<void> source)
+        : stream(stream), source(std::move(source)),
+          method(entry.method), remaining(entry.compressedSize),
+          in(entry.method == 8 ? 262144 : 0), out(262144)
+    {
+        ExcAssert(entry.isSupported());
+        if (method == 8) {
+            memset(&zstream, 0, sizeof(zstream));
+            if (inflateInit2(&zstream, -MAX_WBITS) != Z_OK)
+                throw MLDB::Exception("inflateInit2 failed");
+        }
+    }
+
+    ~ZipMemberStreambuf()
+    {
+        if (method == 8)
+            inflateEnd(&zstream);
+    }
+
+    virtual int_type underflow() override
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+
+        if (method == 0) {
+            size_t toRead = std::min<uint64_t>(remaining, out.size());
+            if (toRead == 0)
+                return traits_type::eof();
+            size_t numRead = readSource(out.data(), toRead);
+            setg(out.data(), out.data(), out.data() + numRead);
+            return traits_type::to_int_type(*gptr());
+        }
+
+        while (!finished) {
+            if (zstream.avail_in == 0 && remaining > 0) {
+                size_t numRead
+                    = readSource(in.data(),
+                                 std::min<uint64_t>(remaining, in.size()));
+                zstream.next_in = (Bytef *)in.data();
+                zstream.avail_in = numRead;
+            }
+
+            zstream.next_out = (Bytef *)out.data();
+            zstream.avail_out = out.size();
+
+            int res = inflate(&zstream, Z_NO_FLUSH);
+            if (res == Z_STREAM_END)
+                finished = true;
+            else if (res != Z_OK && res != Z_BUF_ERROR)
+                throw MLDB::Exception("error decompressing zip member: %s",
+                                      zstream.msg ? zstream.msg : "unknown");
+
+            size_t produced = out.size() - zstream.avail_out;
+            if (produced > 0) {
+                setg(out.data(), out.data(), out.data() + produced);
+                return traits_type::to_int_type(*gptr());
+            }
+
+            if (!finished && zstream.avail_in == 0 && remaining == 0)
+                throw MLDB::Exception("zip member is truncated");
+        }
+
+        return traits_type::eof();
+    }
+
+    size_t readSource(char * buf, size_t length)
+    {
+        stream.read(buf, length);
+        size_t numRead = stream.gcount();
+        if (numRead != length)
+            throw MLDB::Exception("zip member is truncated");
+        remaining -= numRead;
+        return numRead;
+    }
+
+    std::istream & stream;
+    std::shared_ptr<void> source;
+    uint16_t method;
+    uint64_t remaining;     ///< Compressed bytes still to be read
+    std::vector<char> in;
+    std::vector<char> out;
+    z_stream zstream;
+    bool finished = false;
+};
+
+} // file scope
+
+std::unique_ptr<std::streambuf>
+openZipMember(const ZipIndex::Entry & entry,
+              std::istream & stream,
+              std::shared_ptr<void> source)
+{
+    if (!entry.isSupported())
+        throw MLDB::Exception("zip member " + entry.name
+                              + " is encrypted or uses an unsupported "
+                              "compression method");
+
+    std::string header = readAt(stream, entry.localHeaderOffset,
+                                LOCAL_HEADER_SIZE);
+    if (get32(&header[0]) != LOCAL_HEADER_SIGNATURE)
+        throw MLDB::Exception("zip local header not found for " + entry.name);
+
+    uint64_t dataOffset = entry.localHeaderOffset + LOCAL_HEADER_SIZE
+        + get16(&header[26]) + get16(&header[28]);
+    stream.seekg(dataOffset);
+    if (!stream)
+        throw MLDB::Exception("couldn't seek to zip member " + entry.name);
+
+    return std::unique_ptr<std::streambuf>
+        (new ZipMemberStreambuf(entry, stream, std::move(source)));
+}
+
+} // namespace MLDB
@@ -0,0 +1,86 @@
+/** zip_index.h                                                    -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
+
+    Index of the members of a zip file, read from its central directory,
+    which allows members to be opened directly.
+*/
+
+#pragma once
+
+#include "mldb/vfs/fs_utils.h"
+#include <istream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ZIP INDEX                                                                 */
+/*****************************************************************************/
+
+/** Members of a zip file, as listed in its central directory (including
+    zip64 archives, with more than 65535 members or over 4GB).  With it,
+    a member is read by seeking to its data rather than by reading through
+    the archive up to it, so members can be opened independently of each
+    other and read at the same time.
+*/
+struct ZipIndex {
+
+    struct Entry {
+        std::string name;
+        uint16_t flags = 0;
+        uint16_t method = 0;            ///< 0 is stored, 8 is deflated
+        uint64_t compressedSize = 0;
+        uint64_t uncompressedSize = 0;
+        uint64_t localHeaderOffset = 0;
+        Date lastModified;
+
+        bool isDirectory() const
+        {
+            return !name.empty() && name.back() == '/';
+        }
+
+        /** Whether we can read it ourselves; encrypted members and other
+            compression methods need libarchive.
+        */
+        bool isSupported() const
+        {
+            return (flags & 1) == 0 && (method == 0 || method == 8);
+        }
+
+        FsObjectInfo getInfo() const;
+    };
+
+    std::vector<Entry> entries;
+
+    /** Return the entry with the given name, or null. */
+    const Entry * find(const std::string & name) const;
+
+    /** Read the index of a zip file of the given size from a stream that
+        can seek.  Returns null if it's not a zip file.
+    */
+    static std::shared_ptr<const ZipIndex>
+    read(std::istream & stream, uint64_t size);
+
+private:
+    std::unordered_map<std::string, size_t> byName;
+};
+
+
+/*****************************************************************************/
+/* ZIP MEMBER STREAMBUF                                                      */
+/*****************************************************************************/
+
+/** Stream buffer over the (decompressed) data of a member of a zip file,
+    reading from the given stream, which is owned by source.
+*/
+std::unique_ptr<std::streambuf>
+openZipMember(const ZipIndex::Entry & entry,
+              std::istream & stream,
+              std::shared_ptr<void> source);
+
+} // namespace MLDB